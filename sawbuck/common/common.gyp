@@ -67,6 +67,8 @@
         'buffer_parser.h',
         'com_utils.cc',
         'com_utils.h',
+        'etw_session_tuner.cc',
+        'etw_session_tuner.h',
         'initializing_coclass.h',
       ],
     },
@@ -77,6 +79,7 @@
         'buffer_parser_unittest.cc',
         'com_utils_unittest.cc',
         'common_unittest_main.cc',
+        'etw_session_tuner_unittest.cc',
         'initializing_coclass_unittest.cc',
       ],
       'dependencies': [
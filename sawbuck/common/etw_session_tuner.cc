@@ -0,0 +1,151 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// ETW session tuner implementation.
+#include "sawbuck/common/etw_session_tuner.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+
+namespace {
+
+using base::win::EtwTraceController;
+using base::win::EtwTraceProperties;
+
+// Returns the growth of a counter, which ETW never decreases for a session.
+ULONG Delta(ULONG previous, ULONG current) {
+  return current > previous ? current - previous : 0;
+}
+
+}  // namespace
+
+EtwSessionTuner::Options::Options()
+    : max_buffer_memory_kb(32 * 1024),
+      min_flush_timer(1),
+      low_latency(false) {
+}
+
+EtwSessionTuner::EtwSessionTuner(const wchar_t* session_name,
+                                 const Options& options)
+    : session_name_(session_name),
+      options_(options),
+      has_previous_(false),
+      events_lost_(0),
+      buffers_lost_(0) {
+  memset(&previous_, 0, sizeof(previous_));
+}
+
+EtwSessionTuner::~EtwSessionTuner() {
+}
+
+HRESULT EtwSessionTuner::Tune() {
+  EtwTraceProperties props;
+  HRESULT hr = Query(&props);
+  if (FAILED(hr))
+    return hr;
+
+  const EVENT_TRACE_PROPERTIES& current = *props.get();
+  events_lost_ = current.EventsLost;
+  buffers_lost_ = current.LogBuffersLost + current.RealTimeBuffersLost;
+
+  EVENT_TRACE_PROPERTIES update = {};
+  bool needs_update = has_previous_ &&
+      ComputeUpdate(options_, previous_, current, &update);
+  previous_ = current;
+  has_previous_ = true;
+  if (!needs_update)
+    return S_OK;
+
+  // Start from a clean set of properties, as the query also returned the
+  // session and log file names. Leaving the log file name out keeps the
+  // session logging to the same file.
+  EtwTraceProperties new_props;
+  EVENT_TRACE_PROPERTIES* p = new_props.get();
+  p->Wnode.Guid = current.Wnode.Guid;
+  p->Wnode.ClientContext = current.Wnode.ClientContext;
+  p->EnableFlags = current.EnableFlags;
+  p->LogFileMode = current.LogFileMode;
+  p->BufferSize = current.BufferSize;
+  p->MinimumBuffers = current.MinimumBuffers;
+  p->MaximumBuffers = update.MaximumBuffers;
+  p->FlushTimer = update.FlushTimer;
+  p->LogFileNameOffset = 0;
+
+  hr = Update(&new_props);
+  if (FAILED(hr)) {
+    LOG(WARNING) << "Failed to update session \"" << session_name_
+                 << "\", hr=" << std::hex << hr;
+    return hr;
+  }
+
+  // The query at the next poll picks up the properties ETW actually kept.
+  return S_FALSE;
+}
+
+bool EtwSessionTuner::ComputeUpdate(const Options& options,
+                                    const EVENT_TRACE_PROPERTIES& previous,
+                                    const EVENT_TRACE_PROPERTIES& current,
+                                    EVENT_TRACE_PROPERTIES* update) {
+  DCHECK(update != NULL);
+
+  update->MaximumBuffers = current.MaximumBuffers;
+  update->FlushTimer = current.FlushTimer;
+
+  ULONG lost = Delta(previous.EventsLost, current.EventsLost) +
+      Delta(previous.LogBuffersLost, current.LogBuffersLost) +
+      Delta(previous.RealTimeBuffersLost, current.RealTimeBuffersLost);
+  if (lost != 0) {
+    // Grow the buffer pool first, as long as it fits in the memory cap.
+    // BufferSize is in KB.
+    ULONG max_buffers = current.BufferSize == 0 ? 0 :
+        options.max_buffer_memory_kb / current.BufferSize;
+    if (current.MaximumBuffers < max_buffers) {
+      update->MaximumBuffers =
+          std::min(std::max(current.MaximumBuffers * 2, 1UL), max_buffers);
+      return true;
+    }
+
+    // Failing that, flush more often so that the consumer frees the buffers
+    // sooner. A flush timer of zero flushes only full buffers, and is left
+    // alone.
+    if (current.FlushTimer > options.min_flush_timer) {
+      update->FlushTimer =
+          std::max(current.FlushTimer / 2, options.min_flush_timer);
+      return true;
+    }
+
+    return false;
+  }
+
+  // A session that writes a buffer or less per poll holds its events in a
+  // partly full buffer until the flush timer goes off.
+  if (options.low_latency &&
+      Delta(previous.BuffersWritten, current.BuffersWritten) <= 1 &&
+      (current.FlushTimer == 0 ||
+       current.FlushTimer > options.min_flush_timer)) {
+    update->FlushTimer = options.min_flush_timer;
+    return true;
+  }
+
+  return false;
+}
+
+HRESULT EtwSessionTuner::Query(EtwTraceProperties* props) {
+  return EtwTraceController::Query(session_name_.c_str(), props);
+}
+
+HRESULT EtwSessionTuner::Update(EtwTraceProperties* props) {
+  return EtwTraceController::Update(session_name_.c_str(), props);
+}
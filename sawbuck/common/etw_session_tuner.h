@@ -0,0 +1,90 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Adjusts the buffers and flush timer of a running ETW session to the rate
+// of the events it receives.
+#ifndef SAWBUCK_COMMON_ETW_SESSION_TUNER_H_
+#define SAWBUCK_COMMON_ETW_SESSION_TUNER_H_
+
+#include <windows.h>
+#include <evntrace.h>
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/win/event_trace_controller.h"
+
+// Polls the statistics of a running ETW session and, when the session has
+// lost events since the last poll, grows its buffer pool up to a memory cap,
+// then shortens its flush timer. A session that stays quiet may also have its
+// flush timer shortened, so that its few events are delivered promptly.
+class EtwSessionTuner {
+ public:
+  struct Options {
+    Options();
+
+    // The most memory the buffers of the session may take, in KB.
+    ULONG max_buffer_memory_kb;
+    // The shortest flush timer to set, in seconds.
+    ULONG min_flush_timer;
+    // True to shorten the flush timer of a quiet session.
+    bool low_latency;
+  };
+
+  EtwSessionTuner(const wchar_t* session_name, const Options& options);
+  virtual ~EtwSessionTuner();
+
+  // Queries the session and updates its properties if need be.
+  // @returns S_OK if the session was left alone, S_FALSE if it was updated,
+  //     or an error if it couldn't be queried or updated.
+  HRESULT Tune();
+
+  // @returns the number of events and buffers the session lost as of the
+  //     last call to Tune.
+  ULONG events_lost() const { return events_lost_; }
+  ULONG buffers_lost() const { return buffers_lost_; }
+
+  // Computes the adjustment of a session.
+  // @param options the limits of the adjustment.
+  // @param previous the properties of the session at the previous poll.
+  // @param current the properties of the session now.
+  // @param update on success receives the buffer counts and flush timer to
+  //     set on the session.
+  // @returns true iff the session should be updated.
+  static bool ComputeUpdate(const Options& options,
+                            const EVENT_TRACE_PROPERTIES& previous,
+                            const EVENT_TRACE_PROPERTIES& current,
+                            EVENT_TRACE_PROPERTIES* update);
+
+ protected:
+  // @name Test seams.
+  // @{
+  virtual HRESULT Query(base::win::EtwTraceProperties* props);
+  virtual HRESULT Update(base::win::EtwTraceProperties* props);
+  // @}
+
+ private:
+  std::wstring session_name_;
+  Options options_;
+
+  // The properties of the session at the previous poll, if any.
+  bool has_previous_;
+  EVENT_TRACE_PROPERTIES previous_;
+
+  ULONG events_lost_;
+  ULONG buffers_lost_;
+
+  DISALLOW_COPY_AND_ASSIGN(EtwSessionTuner);
+};
+
+#endif  // SAWBUCK_COMMON_ETW_SESSION_TUNER_H_
@@ -0,0 +1,157 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// ETW session tuner unittests.
+#include "sawbuck/common/etw_session_tuner.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+using base::win::EtwTraceProperties;
+using testing::_;
+using testing::DoAll;
+using testing::Invoke;
+using testing::Return;
+
+class TestEtwSessionTuner : public EtwSessionTuner {
+ public:
+  explicit TestEtwSessionTuner(const Options& options)
+      : EtwSessionTuner(L"TestSession", options) {
+  }
+
+  MOCK_METHOD1(Query, HRESULT(EtwTraceProperties* props));
+  MOCK_METHOD1(Update, HRESULT(EtwTraceProperties* props));
+};
+
+class EtwSessionTunerTest : public testing::Test {
+ public:
+  virtual void SetUp() {
+    options_.max_buffer_memory_kb = 1024;
+    options_.min_flush_timer = 1;
+    options_.low_latency = false;
+
+    memset(&previous_, 0, sizeof(previous_));
+    previous_.BufferSize = 64;
+    previous_.MinimumBuffers = 4;
+    previous_.MaximumBuffers = 4;
+    previous_.FlushTimer = 8;
+    previous_.BuffersWritten = 100;
+    current_ = previous_;
+    current_.BuffersWritten = 200;
+  }
+
+  // Responds to a query with current_.
+  HRESULT ReturnCurrent(EtwTraceProperties* props) {
+    *props->get() = current_;
+    return S_OK;
+  }
+
+  // Records the properties of an update.
+  HRESULT SaveUpdate(EtwTraceProperties* props) {
+    updated_ = *props->get();
+    return S_OK;
+  }
+
+  EtwSessionTuner::Options options_;
+  EVENT_TRACE_PROPERTIES previous_;
+  EVENT_TRACE_PROPERTIES current_;
+  EVENT_TRACE_PROPERTIES updated_;
+};
+
+}  // namespace
+
+TEST_F(EtwSessionTunerTest, NoLossNoUpdate) {
+  EVENT_TRACE_PROPERTIES update = {};
+  EXPECT_FALSE(EtwSessionTuner::ComputeUpdate(options_, previous_, current_,
+                                              &update));
+}
+
+TEST_F(EtwSessionTunerTest, LossGrowsBuffersUpToCap) {
+  EVENT_TRACE_PROPERTIES update = {};
+  current_.EventsLost = 10;
+  ASSERT_TRUE(EtwSessionTuner::ComputeUpdate(options_, previous_, current_,
+                                             &update));
+  EXPECT_EQ(8u, update.MaximumBuffers);
+  EXPECT_EQ(8u, update.FlushTimer);
+
+  // The cap is 1024 KB of 64 KB buffers.
+  previous_.MaximumBuffers = current_.MaximumBuffers = 12;
+  previous_.EventsLost = 10;
+  current_.EventsLost = 20;
+  ASSERT_TRUE(EtwSessionTuner::ComputeUpdate(options_, previous_, current_,
+                                             &update));
+  EXPECT_EQ(16u, update.MaximumBuffers);
+}
+
+TEST_F(EtwSessionTunerTest, LossAtCapShortensFlushTimer) {
+  EVENT_TRACE_PROPERTIES update = {};
+  previous_.MaximumBuffers = current_.MaximumBuffers = 16;
+  current_.RealTimeBuffersLost = 1;
+  ASSERT_TRUE(EtwSessionTuner::ComputeUpdate(options_, previous_, current_,
+                                             &update));
+  EXPECT_EQ(16u, update.MaximumBuffers);
+  EXPECT_EQ(4u, update.FlushTimer);
+
+  // The flush timer doesn't go below the minimum.
+  previous_.FlushTimer = current_.FlushTimer = 1;
+  EXPECT_FALSE(EtwSessionTuner::ComputeUpdate(options_, previous_, current_,
+                                              &update));
+}
+
+TEST_F(EtwSessionTunerTest, QuietSessionLowLatency) {
+  EVENT_TRACE_PROPERTIES update = {};
+  current_.BuffersWritten = previous_.BuffersWritten + 1;
+  EXPECT_FALSE(EtwSessionTuner::ComputeUpdate(options_, previous_, current_,
+                                              &update));
+
+  options_.low_latency = true;
+  ASSERT_TRUE(EtwSessionTuner::ComputeUpdate(options_, previous_, current_,
+                                             &update));
+  EXPECT_EQ(1u, update.FlushTimer);
+
+  // A busy session is left alone.
+  current_.BuffersWritten = previous_.BuffersWritten + 10;
+  EXPECT_FALSE(EtwSessionTuner::ComputeUpdate(options_, previous_, current_,
+                                              &update));
+}
+
+TEST_F(EtwSessionTunerTest, Tune) {
+  TestEtwSessionTuner tuner(options_);
+
+  // The first poll only takes a baseline.
+  current_ = previous_;
+  EXPECT_CALL(tuner, Query(_)).WillRepeatedly(
+      Invoke(this, &EtwSessionTunerTest::ReturnCurrent));
+  EXPECT_CALL(tuner, Update(_)).Times(0);
+  EXPECT_EQ(S_OK, tuner.Tune());
+  EXPECT_EQ(0u, tuner.events_lost());
+
+  // Losses get the session updated.
+  current_.EventsLost = 3;
+  current_.LogBuffersLost = 1;
+  EXPECT_CALL(tuner, Update(_)).WillOnce(
+      Invoke(this, &EtwSessionTunerTest::SaveUpdate));
+  EXPECT_EQ(S_FALSE, tuner.Tune());
+  EXPECT_EQ(3u, tuner.events_lost());
+  EXPECT_EQ(1u, tuner.buffers_lost());
+  EXPECT_EQ(8u, updated_.MaximumBuffers);
+  EXPECT_EQ(64u, updated_.BufferSize);
+  EXPECT_EQ(0u, updated_.LogFileNameOffset);
+
+  // Failures are reported.
+  EXPECT_CALL(tuner, Query(_)).WillOnce(Return(E_FAIL));
+  EXPECT_EQ(E_FAIL, tuner.Tune());
+}
@@ -0,0 +1,877 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Benchmarks the log consumer pipeline. This program generates a log file
+// and a kernel log file at scale, then measures the throughput of parsing,
+// ingesting, storing, filtering and symbolizing their events, as well as the
+// peak memory use, and writes the results to a JSON report.
+//
+// Note that generating the log files requires the privilege to start a
+// trace session, e.g. membership in the Administrators or the Performance
+// Log Users groups.
+#include <windows.h>
+#include <psapi.h>
+#include <tlhelp32.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "base/at_exit.h"
+#include "base/bind.h"
+#include "base/command_line.h"
+#include "base/file_path.h"
+#include "base/file_util.h"
+#include "base/json/json_writer.h"
+#include "base/logging.h"
+#include "base/logging_win.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/message_loop.h"
+#include "base/string_number_conversions.h"
+#include "base/stringprintf.h"
+#include "base/threading/thread.h"
+#include "base/time.h"
+#include "base/values.h"
+#include "base/win/event_trace_controller.h"
+#include "base/win/event_trace_provider.h"
+#include "base/win/pe_image.h"
+#include "base/win/scoped_handle.h"
+#include "sawbuck/log_lib/kernel_log_consumer.h"
+#include "sawbuck/log_lib/kernel_log_unittest_data.h"
+#include "sawbuck/log_lib/kernel_timeline.h"
+#include "sawbuck/log_lib/log_consumer.h"
+#include "sawbuck/log_lib/symbol_lookup_service.h"
+#include "sawbuck/viewer/log_store.h"
+
+#include <initguid.h>  // NOLINT - must precede only kernel_log_types.h.
+#include "sawbuck/log_lib/kernel_log_types.h"
+
+namespace {
+
+// {8E9A3C61-2F4B-4D7A-9C15-63B0E4A27D58}
+DEFINE_GUID(kBenchmarkProviderName,
+    0x8e9a3c61, 0x2f4b, 0x4d7a,
+    0x9c, 0x15, 0x63, 0xb0, 0xe4, 0xa2, 0x7d, 0x58);
+
+const wchar_t kSessionName[] = L"Log Lib Benchmark Session";
+
+const char kUsage[] =
+    "Usage: log_lib_benchmark [options]\n"
+    "\n"
+    "  Generates a log file and a kernel log file, then measures the\n"
+    "  throughput of parsing, ingesting, storing, filtering and\n"
+    "  symbolizing them.\n"
+    "\n"
+    "  Options:\n"
+    "    --events=<n> the number of log messages to generate, defaults\n"
+    "        to 1000000.\n"
+    "    --trace-percent=<n> the percentage of the log messages that carry\n"
+    "        a stack trace, defaults to 50.\n"
+    "    --processes=<n> the number of processes whose kernel events to\n"
+    "        generate, defaults to 10000.\n"
+    "    --symbolize-traces=<n> the number of stack traces to symbolize,\n"
+    "        defaults to 10000.\n"
+    "    --work-dir=<path> the directory to generate the log files in,\n"
+    "        defaults to the temporary directory.\n"
+    "    --output=<path> the file to write the JSON report to. The report\n"
+    "        is written to standard output in any case.\n";
+
+const int kDefaultEvents = 1000000;
+const int kDefaultTracePercent = 50;
+const int kDefaultProcesses = 10000;
+const int kDefaultSymbolizeTraces = 10000;
+
+// The process ids of the generated kernel events start here.
+const DWORD kFirstProcessId = 0x10000;
+
+// The log messages of the filter phase are those at warning level or
+// above containing this text.
+const char kFilterText[] = "message 4";
+
+const char kSourceFile[] = "sawbuck\\log_lib\\benchmark_main.cc";
+
+// The log message levels cycle through these.
+const UCHAR kLevels[] = {
+  TRACE_LEVEL_ERROR,
+  TRACE_LEVEL_WARNING,
+  TRACE_LEVEL_INFORMATION,
+  TRACE_LEVEL_VERBOSE,
+};
+
+// The kernel events are generated in the layout of this machine's kernel.
+#ifdef _WIN64
+typedef kernel_log_types::ImageLoad64V2 ImageLoad;
+typedef kernel_log_types::ProcessInfo64V3 ProcessInfo;
+#else
+typedef kernel_log_types::ImageLoad32V2 ImageLoad;
+typedef kernel_log_types::ProcessInfo32V3 ProcessInfo;
+#endif
+const UCHAR kImageLoadVersion = 2;
+const UCHAR kProcessInfoVersion = 3;
+
+// @returns the peak working set of this process so far.
+size_t GetPeakWorkingSet() {
+  PROCESS_MEMORY_COUNTERS counters = { sizeof(counters) };
+  if (!::GetProcessMemoryInfo(::GetCurrentProcess(),
+                              &counters,
+                              sizeof(counters))) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "GetProcessMemoryInfo failed, error " << error;
+    return 0;
+  }
+
+  return counters.PeakWorkingSetSize;
+}
+
+// Creates the report entry of a benchmark phase.
+// @param start the time the phase started.
+// @param items the number of items the phase processed.
+// @param bytes the number of bytes the phase processed, if applicable.
+// @returns the new report entry, which the caller owns.
+base::DictionaryValue* PhaseResults(const base::TimeTicks& start,
+                                    size_t items,
+                                    uint64 bytes) {
+  double seconds = (base::TimeTicks::Now() - start).InSecondsF();
+
+  scoped_ptr<base::DictionaryValue> results(new base::DictionaryValue());
+  results->SetDouble("seconds", seconds);
+  results->SetDouble("items", static_cast<double>(items));
+  if (seconds > 0)
+    results->SetDouble("items_per_second", items / seconds);
+  if (bytes != 0) {
+    results->SetDouble("bytes", static_cast<double>(bytes));
+    if (seconds > 0)
+      results->SetDouble("bytes_per_second", bytes / seconds);
+  }
+  results->SetDouble("peak_working_set_bytes",
+                     static_cast<double>(GetPeakWorkingSet()));
+
+  return results.release();
+}
+
+// Reads an optional positive integer switch.
+// @param name the name of the switch.
+// @param default_value the value to use when the switch is absent.
+// @param value on success, returns the value of the switch.
+// @returns false iff the switch is present but malformed.
+bool GetIntSwitch(const char* name, int default_value, int* value) {
+  DCHECK(value != NULL);
+
+  const CommandLine* cmd_line = CommandLine::ForCurrentProcess();
+  if (!cmd_line->HasSwitch(name)) {
+    *value = default_value;
+    return true;
+  }
+
+  return base::StringToInt(cmd_line->GetSwitchValueASCII(name), value) &&
+      *value >= 0;
+}
+
+// Logs the events of the benchmark provider to a file.
+class FileSession {
+ public:
+  FileSession() : provider_(kBenchmarkProviderName), failed_events_(0) {
+  }
+
+  ~FileSession() {
+    Stop();
+  }
+
+  // Starts logging to the file at @p path, replacing any previous file.
+  // @returns true on success.
+  bool Start(const FilePath& path) {
+    // Stop any dangling session from previous, crashing runs.
+    base::win::EtwTraceProperties ignore;
+    base::win::EtwTraceController::Stop(kSessionName, &ignore);
+    file_util::Delete(path, false);
+
+    base::win::EtwTraceProperties prop;
+    HRESULT hr = prop.SetLoggerFileName(path.value().c_str());
+    if (FAILED(hr)) {
+      LOG(ERROR) << "Failed to set the log file name, error " << hr;
+      return false;
+    }
+
+    // Unlike EtwTraceController::StartFileSession, don't limit the file
+    // size, and buffer generously so the provider rarely has to wait.
+    EVENT_TRACE_PROPERTIES& p = *prop.get();
+    p.Wnode.ClientContext = 1;  // QPC timer accuracy.
+    p.LogFileMode = EVENT_TRACE_FILE_MODE_SEQUENTIAL;
+    p.MaximumFileSize = 0;
+    p.BufferSize = 1024;  // In kilobytes.
+    p.MinimumBuffers = 16;
+    p.MaximumBuffers = 128;
+    p.FlushTimer = 1;
+
+    hr = controller_.Start(kSessionName, &prop);
+    if (FAILED(hr)) {
+      LOG(ERROR) << "Failed to start the trace session, error " << hr;
+      return false;
+    }
+
+    hr = controller_.EnableProvider(kBenchmarkProviderName,
+                                    TRACE_LEVEL_VERBOSE,
+                                    0xFFFFFFFF);
+    if (FAILED(hr)) {
+      LOG(ERROR) << "Failed to enable the provider, error " << hr;
+      return false;
+    }
+
+    ULONG error = provider_.Register();
+    if (error != ERROR_SUCCESS) {
+      LOG(ERROR) << "Failed to register the provider, error " << error;
+      return false;
+    }
+
+    return true;
+  }
+
+  // Flushes the file and stops the session.
+  void Stop() {
+    provider_.Unregister();
+    if (controller_.session() != NULL)
+      controller_.Stop(NULL);
+  }
+
+  // Logs @p event, waiting for a free buffer rather than losing it.
+  void Log(EVENT_TRACE_HEADER* event) {
+    ULONG error = ERROR_SUCCESS;
+    while ((error = provider_.Log(event)) == ERROR_NOT_ENOUGH_MEMORY)
+      ::Sleep(1);
+
+    if (error != ERROR_SUCCESS)
+      ++failed_events_;
+  }
+
+  // @returns the number of events that could not be logged.
+  size_t failed_events() const { return failed_events_; }
+
+ private:
+  base::win::EtwTraceController controller_;
+  base::win::EtwTraceProvider provider_;
+  size_t failed_events_;
+
+  DISALLOW_COPY_AND_ASSIGN(FileSession);
+};
+
+// Generates a log file of @p num_events log messages, @p trace_percent of
+// which carry a stack trace, along with file and line information.
+// @returns the report entry of the generation, or NULL on failure.
+base::DictionaryValue* GenerateLogFile(const FilePath& path,
+                                       int num_events,
+                                       int trace_percent) {
+  FileSession session;
+  if (!session.Start(path))
+    return NULL;
+
+  base::TimeTicks start(base::TimeTicks::Now());
+  uint64 bytes = 0;
+  for (int i = 0; i < num_events; ++i) {
+    UCHAR level = kLevels[i % arraysize(kLevels)];
+    std::string message(base::StringPrintf(
+        "Synthetic log message %d, of a representative length for the "
+        "messages of a browser.", i));
+
+    if (i % 100 < trace_percent) {
+      void* trace[32];
+      DWORD depth = ::CaptureStackBackTrace(0, arraysize(trace), trace, NULL);
+      DWORD line = i % 1000 + 1;
+
+      base::win::EtwMofEvent<5> event(logging::kLogEventId,
+                                      logging::LOG_MESSAGE_FULL,
+                                      level);
+      event.SetField(0, sizeof(depth), &depth);
+      event.SetField(1, sizeof(trace[0]) * depth, trace);
+      event.SetField(2, sizeof(line), &line);
+      event.SetField(3, sizeof(kSourceFile), kSourceFile);
+      event.SetField(4, message.length() + 1, message.c_str());
+      session.Log(event.get());
+
+      bytes += sizeof(depth) + sizeof(trace[0]) * depth + sizeof(line) +
+          sizeof(kSourceFile) + message.length() + 1;
+    } else {
+      base::win::EtwMofEvent<1> event(logging::kLogEventId,
+                                      logging::LOG_MESSAGE,
+                                      level);
+      event.SetField(0, message.length() + 1, message.c_str());
+      session.Log(event.get());
+
+      bytes += message.length() + 1;
+    }
+  }
+  session.Stop();
+
+  base::DictionaryValue* results = PhaseResults(start, num_events, bytes);
+  results->SetDouble("failed_events",
+                     static_cast<double>(session.failed_events()));
+  return results;
+}
+
+// Logs a process event in the layout of this machine's kernel.
+void LogProcessEvent(const KernelProcessEvents::ProcessInfo& process,
+                     DWORD exit_status,
+                     base::win::EtwEventType event_type,
+                     FileSession* session) {
+  ProcessInfo info = {};
+  info.ProcessId = process.process_id;
+  info.ParentId = process.parent_id;
+  info.SessionId = process.session_id;
+  info.ExitStatus = exit_status;
+
+  base::win::EtwMofEvent<4> event(kernel_log_types::kProcessEventClass,
+                                  event_type,
+                                  kProcessInfoVersion,
+                                  TRACE_LEVEL_INFORMATION);
+  event.SetField(0, FIELD_OFFSET(ProcessInfo, UserSID), &info);
+  size_t sid_len = ::GetLengthSid(const_cast<SID*>(&process.user_sid));
+  event.SetField(1, sid_len, &process.user_sid);
+  event.SetField(2,
+                 process.image_name.length() + 1,
+                 process.image_name.c_str());
+  event.SetField(3,
+                 (process.command_line.length() + 1) * sizeof(wchar_t),
+                 process.command_line.c_str());
+  session->Log(event.get());
+}
+
+// Logs a module load event in the layout of this machine's kernel.
+void LogImageLoadEvent(DWORD process_id,
+                       const sym_util::ModuleInformation& module,
+                       FileSession* session) {
+  ImageLoad load = {};
+  load.BaseAddress = static_cast<ULONG_PTR>(module.base_address);
+  load.ModuleSize = module.module_size;
+  load.ProcessId = process_id;
+  load.ImageChecksum = module.image_checksum;
+  load.TimeDateStamp = module.time_date_stamp;
+
+  base::win::EtwMofEvent<2> event(kernel_log_types::kImageLoadEventClass,
+                                  kernel_log_types::kImageNotifyLoadEvent,
+                                  kImageLoadVersion,
+                                  TRACE_LEVEL_INFORMATION);
+  event.SetField(0, FIELD_OFFSET(ImageLoad, ImageFileName), &load);
+  event.SetField(1,
+                 sizeof(wchar_t) * (module.image_file_name.size() + 1),
+                 module.image_file_name.data());
+  session->Log(event.get());
+}
+
+// Generates a kernel log file where @p num_processes processes in turn
+// start, load the test modules, and end.
+// @param num_events on success, returns the number of events generated.
+// @returns the report entry of the generation, or NULL on failure.
+base::DictionaryValue* GenerateKernelLogFile(const FilePath& path,
+                                             int num_processes,
+                                             size_t* num_events) {
+  DCHECK(num_events != NULL);
+
+  FileSession session;
+  if (!session.Start(path))
+    return NULL;
+
+  base::TimeTicks start(base::TimeTicks::Now());
+  *num_events = 0;
+  for (int i = 0; i < num_processes; ++i) {
+    KernelProcessEvents::ProcessInfo process =
+        testing::process_list[i % testing::kNumProcesses];
+    process.process_id = kFirstProcessId + i;
+
+    LogProcessEvent(process,
+                    STILL_ACTIVE,
+                    kernel_log_types::kProcessStartEvent,
+                    &session);
+    for (size_t j = 0; j < testing::kNumModules; ++j)
+      LogImageLoadEvent(process.process_id, testing::module_list[j], &session);
+    LogProcessEvent(process,
+                    ERROR_SUCCESS,
+                    kernel_log_types::kProcessEndEvent,
+                    &session);
+
+    *num_events += testing::kNumModules + 2;
+  }
+  session.Stop();
+
+  base::DictionaryValue* results = PhaseResults(start, *num_events, 0);
+  results->SetDouble("failed_events",
+                     static_cast<double>(session.failed_events()));
+  return results;
+}
+
+// Counts the log messages, without keeping them.
+class CountingLogSink : public LogEvents {
+ public:
+  CountingLogSink() : messages_(0), bytes_(0) {
+  }
+
+  virtual void OnLogMessage(const LogMessage& log_message) {
+    ++messages_;
+    bytes_ += log_message.message_len + log_message.file_len +
+        log_message.trace_depth * sizeof(log_message.traces[0]);
+  }
+
+  size_t messages() const { return messages_; }
+  uint64 bytes() const { return bytes_; }
+
+ private:
+  size_t messages_;
+  uint64 bytes_;
+
+  DISALLOW_COPY_AND_ASSIGN(CountingLogSink);
+};
+
+// Keeps a copy of the log messages, as a viewer would.
+class StoringLogSink : public LogEvents {
+ public:
+  struct Message {
+    base::Time time;
+    UCHAR level;
+    DWORD process_id;
+    DWORD thread_id;
+    std::string file;
+    int line;
+    std::string message;
+    std::vector<void*> trace;
+  };
+
+  StoringLogSink() : bytes_(0) {
+  }
+
+  virtual void OnLogMessage(const LogMessage& log_message) {
+    messages_.push_back(Message());
+    Message& message = messages_.back();
+    message.time = log_message.time;
+    message.level = log_message.level;
+    message.process_id = log_message.process_id;
+    message.thread_id = log_message.thread_id;
+    message.file.assign(log_message.file, log_message.file_len);
+    message.line = log_message.line;
+    message.message.assign(log_message.message, log_message.message_len);
+    message.trace.assign(log_message.traces,
+                         log_message.traces + log_message.trace_depth);
+
+    bytes_ += log_message.message_len + log_message.file_len +
+        log_message.trace_depth * sizeof(log_message.traces[0]);
+  }
+
+  const std::vector<Message>& messages() const { return messages_; }
+  uint64 bytes() const { return bytes_; }
+
+ private:
+  std::vector<Message> messages_;
+  uint64 bytes_;
+
+  DISALLOW_COPY_AND_ASSIGN(StoringLogSink);
+};
+
+// Keeps the log messages in a LogStore, as the viewer does. The store only
+// copies the text of the messages, and the file names and stack traces it
+// hasn't seen yet, out of the event buffers.
+class LogStoreSink : public LogEvents {
+ public:
+  explicit LogStoreSink(LogStore* store) : store_(store), bytes_(0) {
+    DCHECK(store != NULL);
+  }
+
+  virtual void OnLogMessage(const LogMessage& log_message) {
+    store_->Append(log_message.level,
+                   log_message.process_id,
+                   log_message.thread_id,
+                   log_message.time,
+                   base::StringPiece(log_message.file, log_message.file_len),
+                   log_message.line,
+                   base::StringPiece(log_message.message,
+                                     log_message.message_len),
+                   log_message.traces,
+                   log_message.trace_depth);
+
+    bytes_ += log_message.message_len + log_message.file_len +
+        log_message.trace_depth * sizeof(log_message.traces[0]);
+  }
+
+  uint64 bytes() const { return bytes_; }
+
+ private:
+  LogStore* store_;
+  uint64 bytes_;
+
+  DISALLOW_COPY_AND_ASSIGN(LogStoreSink);
+};
+
+// Parses the log file on the consuming thread, without keeping the log
+// messages.
+// @returns the report entry of the phase, or NULL on failure.
+base::DictionaryValue* ParseLogFile(const FilePath& path) {
+  CountingLogSink sink;
+  LogConsumer consumer;
+  consumer.set_event_sink(&sink);
+
+  HRESULT hr = consumer.OpenFileSession(path.value().c_str());
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failed to open " << path.value() << ", error " << hr;
+    return NULL;
+  }
+
+  base::TimeTicks start(base::TimeTicks::Now());
+  hr = consumer.Consume();
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failed to consume " << path.value() << ", error " << hr;
+    return NULL;
+  }
+
+  return PhaseResults(start, sink.messages(), sink.bytes());
+}
+
+// Parses the log file on the decoding thread, keeping a copy of the log
+// messages in @p sink.
+// @returns the report entry of the phase, or NULL on failure.
+base::DictionaryValue* IngestLogFile(const FilePath& path,
+                                     StoringLogSink* sink) {
+  DCHECK(sink != NULL);
+
+  LogConsumer consumer;
+  consumer.set_event_sink(sink);
+
+  HRESULT hr = consumer.OpenFileSession(path.value().c_str());
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failed to open " << path.value() << ", error " << hr;
+    return NULL;
+  }
+
+  base::TimeTicks start(base::TimeTicks::Now());
+  consumer.StartDecoding();
+  hr = consumer.Consume();
+  consumer.StopDecoding();
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failed to consume " << path.value() << ", error " << hr;
+    return NULL;
+  }
+
+  base::DictionaryValue* results =
+      PhaseResults(start, sink->messages().size(), sink->bytes());
+  results->SetDouble("dropped_events",
+                     static_cast<double>(consumer.dropped_events()));
+  return results;
+}
+
+// Parses the log file on the decoding thread into @p store. Compared with
+// the ingest phase, this measures the copies the store saves.
+// @returns the report entry of the phase, or NULL on failure.
+base::DictionaryValue* StoreLogFile(const FilePath& path, LogStore* store) {
+  DCHECK(store != NULL);
+
+  LogStoreSink sink(store);
+  LogConsumer consumer;
+  consumer.set_event_sink(&sink);
+
+  HRESULT hr = consumer.OpenFileSession(path.value().c_str());
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failed to open " << path.value() << ", error " << hr;
+    return NULL;
+  }
+
+  base::TimeTicks start(base::TimeTicks::Now());
+  consumer.StartDecoding();
+  hr = consumer.Consume();
+  consumer.StopDecoding();
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failed to consume " << path.value() << ", error " << hr;
+    return NULL;
+  }
+
+  base::DictionaryValue* results =
+      PhaseResults(start, store->size(), sink.bytes());
+  results->SetDouble("dropped_events",
+                     static_cast<double>(consumer.dropped_events()));
+  results->SetDouble("stored_text_bytes",
+                     static_cast<double>(store->text_size()));
+  results->SetDouble("interned_files",
+                     static_cast<double>(store->file_count()));
+  results->SetDouble("interned_traces",
+                     static_cast<double>(store->trace_count()));
+  return results;
+}
+
+// Filters the ingested log messages by level and text.
+// @returns the report entry of the phase.
+base::DictionaryValue* FilterLogMessages(const StoringLogSink& sink) {
+  typedef std::vector<StoringLogSink::Message> Messages;
+  const Messages& messages = sink.messages();
+
+  base::TimeTicks start(base::TimeTicks::Now());
+  size_t matches = 0;
+  Messages::const_iterator it = messages.begin();
+  for (; it != messages.end(); ++it) {
+    if (it->level <= TRACE_LEVEL_WARNING &&
+        it->message.find(kFilterText) != std::string::npos) {
+      ++matches;
+    }
+  }
+
+  base::DictionaryValue* results = PhaseResults(start, messages.size(), 0);
+  results->SetDouble("matches", static_cast<double>(matches));
+  return results;
+}
+
+// Parses the kernel log file into a kernel timeline.
+// @param num_events the number of events in the file.
+// @returns the report entry of the phase, or NULL on failure.
+base::DictionaryValue* ParseKernelLogFile(const FilePath& path,
+                                          size_t num_events) {
+  KernelTimeline timeline;
+  KernelLogConsumer consumer;
+  consumer.set_infer_bitness_from_log(false);
+  consumer.set_is_64_bit_log(sizeof(void*) == 8);
+  consumer.set_module_event_sink(&timeline);
+  consumer.set_process_event_sink(&timeline);
+
+  HRESULT hr = consumer.OpenFileSession(path.value().c_str());
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failed to open " << path.value() << ", error " << hr;
+    return NULL;
+  }
+
+  base::TimeTicks start(base::TimeTicks::Now());
+  hr = consumer.Consume();
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failed to consume " << path.value() << ", error " << hr;
+    return NULL;
+  }
+
+  return PhaseResults(start, num_events, 0);
+}
+
+// Resolves the addresses of stack traces through a symbol lookup service.
+class SymbolizeBenchmark {
+ public:
+  SymbolizeBenchmark() : background_thread_("Symbol Lookup"), requested_(0),
+      resolved_(0), named_(0) {
+  }
+
+  // Resolves all addresses of the first @p num_traces stack traces in
+  // @p sink, in a process with the modules of this process loaded.
+  // @returns the report entry of the phase, or NULL on failure.
+  base::DictionaryValue* Run(const StoringLogSink& sink, int num_traces) {
+    if (!background_thread_.Start()) {
+      LOG(ERROR) << "Failed to start the symbol lookup thread";
+      return NULL;
+    }
+
+    KernelTimeline timeline;
+    LoadModules(&timeline);
+
+    base::TimeTicks start(base::TimeTicks::Now());
+    {
+      SymbolLookupService service;
+      service.set_background_thread(background_thread_.message_loop());
+      service.set_kernel_timeline(&timeline);
+
+      typedef std::vector<StoringLogSink::Message> Messages;
+      const Messages& messages = sink.messages();
+      Messages::const_iterator it = messages.begin();
+      for (; it != messages.end() && num_traces > 0; ++it) {
+        if (it->trace.empty())
+          continue;
+
+        --num_traces;
+        for (size_t i = 0; i < it->trace.size(); ++i) {
+          ++requested_;
+          service.ResolveAddress(
+              it->process_id, it->time,
+              reinterpret_cast<sym_util::Address>(it->trace[i]),
+              base::Bind(&SymbolizeBenchmark::SymbolResolved,
+                         base::Unretained(this)));
+        }
+      }
+
+      if (requested_ != 0)
+        message_loop_.Run();
+
+      // The lookups are done, but the service's tasks must be as well
+      // before it goes away.
+      background_thread_.Stop();
+    }
+
+    base::DictionaryValue* results = PhaseResults(start, requested_, 0);
+    results->SetDouble("named_symbols", static_cast<double>(named_));
+    return results;
+  }
+
+ private:
+  // Loads the modules of this process into @p timeline.
+  void LoadModules(KernelTimeline* timeline) {
+    DCHECK(timeline != NULL);
+
+    base::win::ScopedHandle snap(
+        ::CreateToolhelp32Snapshot(TH32CS_SNAPMODULE, ::GetCurrentProcessId()));
+    base::Time now(base::Time::Now());
+
+    MODULEENTRY32 module = { sizeof(module) };
+    if (!::Module32First(snap, &module))
+      return;
+
+    do {
+      base::win::PEImage image(module.hModule);
+      if (!image.VerifyMagic())
+        continue;
+
+      sym_util::ModuleInformation module_info;
+      module_info.base_address =
+          reinterpret_cast<sym_util::ModuleBase>(module.modBaseAddr);
+      module_info.module_size = module.modBaseSize;
+      module_info.image_checksum =
+          image.GetNTHeaders()->OptionalHeader.CheckSum;
+      module_info.time_date_stamp =
+          image.GetNTHeaders()->FileHeader.TimeDateStamp;
+      module_info.image_file_name = module.szExePath;
+
+      timeline->OnModuleIsLoaded(::GetCurrentProcessId(), now, module_info);
+    } while (::Module32Next(snap, &module));
+  }
+
+  void SymbolResolved(sym_util::ProcessId pid, base::Time time,
+                      sym_util::Address address,
+                      SymbolLookupService::Handle handle,
+                      const sym_util::Symbol& symbol) {
+    if (!symbol.name.empty())
+      ++named_;
+
+    if (++resolved_ == requested_)
+      message_loop_.Quit();
+  }
+
+  base::MessageLoop message_loop_;
+  base::Thread background_thread_;
+
+  size_t requested_;
+  size_t resolved_;
+  size_t named_;
+
+  DISALLOW_COPY_AND_ASSIGN(SymbolizeBenchmark);
+};
+
+int Usage(const char* error) {
+  if (error != NULL)
+    std::cerr << error << std::endl << std::endl;
+  std::cerr << kUsage;
+
+  return 1;
+}
+
+}  // namespace
+
+int wmain(int argc, const wchar_t** argv) {
+  base::AtExitManager at_exit;
+  CommandLine::Init(0, NULL);
+
+  const CommandLine* cmd_line = CommandLine::ForCurrentProcess();
+  if (cmd_line->HasSwitch("help"))
+    return Usage(NULL);
+
+  int num_events = 0;
+  int trace_percent = 0;
+  int num_processes = 0;
+  int symbolize_traces = 0;
+  if (!GetIntSwitch("events", kDefaultEvents, &num_events) ||
+      !GetIntSwitch("trace-percent", kDefaultTracePercent, &trace_percent) ||
+      !GetIntSwitch("processes", kDefaultProcesses, &num_processes) ||
+      !GetIntSwitch("symbolize-traces", kDefaultSymbolizeTraces,
+                    &symbolize_traces)) {
+    return Usage("Malformed numeric switch.");
+  }
+  if (trace_percent > 100)
+    return Usage("The trace percentage must be at most 100.");
+
+  FilePath work_dir = cmd_line->GetSwitchValuePath("work-dir");
+  if (work_dir.empty() && !file_util::GetTempDir(&work_dir))
+    return Usage("Unable to find the temporary directory.");
+
+  FilePath log_path(work_dir.Append(L"log_lib_benchmark.etl"));
+  FilePath kernel_log_path(work_dir.Append(L"log_lib_benchmark_kernel.etl"));
+
+  base::DictionaryValue report;
+  base::DictionaryValue* configuration = new base::DictionaryValue();
+  configuration->SetInteger("events", num_events);
+  configuration->SetInteger("trace_percent", trace_percent);
+  configuration->SetInteger("processes", num_processes);
+  configuration->SetInteger("symbolize_traces", symbolize_traces);
+  report.Set("configuration", configuration);
+
+  // Each phase adds its entry to the report, or fails the benchmark.
+  base::DictionaryValue* results =
+      GenerateLogFile(log_path, num_events, trace_percent);
+  if (results == NULL)
+    return 1;
+  report.Set("generate_log", results);
+
+  size_t num_kernel_events = 0;
+  results = GenerateKernelLogFile(kernel_log_path,
+                                  num_processes,
+                                  &num_kernel_events);
+  if (results == NULL)
+    return 1;
+  report.Set("generate_kernel_log", results);
+
+  results = ParseLogFile(log_path);
+  if (results == NULL)
+    return 1;
+  report.Set("parse_log", results);
+
+  results = ParseKernelLogFile(kernel_log_path, num_kernel_events);
+  if (results == NULL)
+    return 1;
+  report.Set("parse_kernel_log", results);
+
+  StoringLogSink sink;
+  results = IngestLogFile(log_path, &sink);
+  if (results == NULL)
+    return 1;
+  report.Set("ingest_log", results);
+
+  // The later phases work on the ingested copies, so the store is released
+  // right away.
+  {
+    LogStore store;
+    results = StoreLogFile(log_path, &store);
+    if (results == NULL)
+      return 1;
+    report.Set("store_log", results);
+  }
+
+  report.Set("filter_log", FilterLogMessages(sink));
+
+  SymbolizeBenchmark symbolize;
+  results = symbolize.Run(sink, symbolize_traces);
+  if (results == NULL)
+    return 1;
+  report.Set("symbolize", results);
+
+  file_util::Delete(log_path, false);
+  file_util::Delete(kernel_log_path, false);
+
+  std::string json;
+  base::JSONWriter::WriteWithOptions(&report,
+                                     base::JSONWriter::OPTIONS_PRETTY_PRINT,
+                                     &json);
+  std::cout << json;
+
+  FilePath output = cmd_line->GetSwitchValuePath("output");
+  if (!output.empty() &&
+      file_util::WriteFile(output, json.data(), json.size()) !=
+          static_cast<int>(json.size())) {
+    LOG(ERROR) << "Failed to write the report to " << output.value();
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,271 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// CPU profile implementation.
+#include "sawbuck/log_lib/cpu_profile.h"
+
+#include <algorithm>
+#include "base/bind.h"
+#include "base/logging.h"
+
+namespace {
+
+bool HasMoreAddressSamples(const CpuProfile::AddressSamples& a,
+                           const CpuProfile::AddressSamples& b) {
+  if (a.count != b.count)
+    return a.count > b.count;
+  if (a.process_id != b.process_id)
+    return a.process_id < b.process_id;
+  return a.address < b.address;
+}
+
+bool HasMoreSymbolSamples(const CpuProfileSymbolizer::SymbolSamples& a,
+                          const CpuProfileSymbolizer::SymbolSamples& b) {
+  if (a.count != b.count)
+    return a.count > b.count;
+  if (a.process_id != b.process_id)
+    return a.process_id < b.process_id;
+  if (a.module != b.module)
+    return a.module < b.module;
+  return a.function < b.function;
+}
+
+}  // namespace
+
+CpuProfile::CpuProfile(base::TimeDelta resolution)
+    : total_samples_(0),
+      last_bucket_(0),
+      last_process_id_(0),
+      last_counters_(NULL),
+      resolution_(resolution) {
+  DCHECK_LT(0, resolution_.InMicroseconds());
+}
+
+CpuProfile::~CpuProfile() {
+}
+
+int64 CpuProfile::GetBucket(const base::Time& time) const {
+  return time.ToInternalValue() / resolution_.InMicroseconds();
+}
+
+void CpuProfile::OnSampledProfile(DWORD process_id,
+                                  DWORD thread_id,
+                                  const base::Time& time,
+                                  sym_util::Address instruction_pointer,
+                                  ULONG count) {
+  int64 bucket = GetBucket(time);
+
+  base::AutoLock lock(lock_);
+  if (last_counters_ == NULL || bucket != last_bucket_ ||
+      process_id != last_process_id_) {
+    last_counters_ = &buckets_[bucket][process_id];
+    last_bucket_ = bucket;
+    last_process_id_ = process_id;
+  }
+
+  Counter& counter = (*last_counters_)[instruction_pointer];
+  if (counter.count == 0 || time < counter.first_time)
+    counter.first_time = time;
+  counter.count += count;
+  total_samples_ += count;
+}
+
+size_t CpuProfile::GetAddressSamples(const base::Time& start,
+                                     const base::Time& end,
+                                     AddressSampleList* samples) const {
+  DCHECK(samples != NULL);
+  samples->clear();
+
+  typedef std::map<std::pair<sym_util::ProcessId, sym_util::Address>,
+                   Counter> MergedCounters;
+  MergedCounters merged;
+  size_t total = 0;
+
+  {
+    base::AutoLock lock(lock_);
+    BucketMap::const_iterator it(buckets_.lower_bound(GetBucket(start)));
+    BucketMap::const_iterator last(buckets_.lower_bound(GetBucket(end)));
+    // The bucket of the end time overlaps the range unless the range ends
+    // on its start.
+    if (last != buckets_.end() &&
+        last->first * resolution_.InMicroseconds() < end.ToInternalValue()) {
+      ++last;
+    }
+
+    for (; it != last; ++it) {
+      ProcessCounters::const_iterator process(it->second.begin());
+      for (; process != it->second.end(); ++process) {
+        AddressCounters::const_iterator address(process->second.begin());
+        for (; address != process->second.end(); ++address) {
+          Counter& counter =
+              merged[std::make_pair(process->first, address->first)];
+          if (counter.count == 0 ||
+              address->second.first_time < counter.first_time) {
+            counter.first_time = address->second.first_time;
+          }
+          counter.count += address->second.count;
+          total += address->second.count;
+        }
+      }
+    }
+  }
+
+  samples->reserve(merged.size());
+  MergedCounters::const_iterator it(merged.begin());
+  for (; it != merged.end(); ++it) {
+    AddressSamples address_samples = {};
+    address_samples.process_id = it->first.first;
+    address_samples.address = it->first.second;
+    address_samples.first_time = it->second.first_time;
+    address_samples.count = it->second.count;
+    samples->push_back(address_samples);
+  }
+  std::sort(samples->begin(), samples->end(), HasMoreAddressSamples);
+
+  return total;
+}
+
+void CpuProfile::Clear() {
+  base::AutoLock lock(lock_);
+  buckets_.clear();
+  total_samples_ = 0;
+  last_counters_ = NULL;
+}
+
+size_t CpuProfile::total_samples() const {
+  base::AutoLock lock(lock_);
+  return total_samples_;
+}
+
+const size_t CpuProfileSymbolizer::kMaxResolvedAddresses;
+const wchar_t CpuProfileSymbolizer::kUnknown[] = L"<unknown>";
+
+CpuProfileSymbolizer::CpuProfileSymbolizer(
+    ISymbolLookupService* lookup_service) : lookup_service_(lookup_service) {
+  DCHECK(lookup_service_ != NULL);
+}
+
+CpuProfileSymbolizer::~CpuProfileSymbolizer() {
+  Cancel();
+}
+
+void CpuProfileSymbolizer::Symbolize(
+    const CpuProfile::AddressSampleList& samples,
+    const CompletionCallback& callback) {
+  Cancel();
+  callback_ = callback;
+
+  for (size_t i = 0; i < samples.size(); ++i) {
+    const CpuProfile::AddressSamples& address_samples = samples[i];
+
+    Handle handle = ISymbolLookupService::kInvalidHandle;
+    if (i < kMaxResolvedAddresses) {
+      handle = lookup_service_->ResolveAddress(
+          address_samples.process_id,
+          address_samples.first_time,
+          address_samples.address,
+          base::Bind(&CpuProfileSymbolizer::SymbolResolved,
+                     base::Unretained(this)));
+    }
+
+    if (handle != ISymbolLookupService::kInvalidHandle) {
+      pending_[handle] = address_samples.count;
+    } else {
+      AddSamples(address_samples.process_id, kUnknown, kUnknown,
+                 address_samples.count);
+    }
+  }
+
+  if (pending_.empty())
+    Complete();
+}
+
+void CpuProfileSymbolizer::Cancel() {
+  PendingMap::const_iterator it(pending_.begin());
+  for (; it != pending_.end(); ++it)
+    lookup_service_->CancelRequest(it->first);
+
+  pending_.clear();
+  functions_.clear();
+  callback_.Reset();
+}
+
+void CpuProfileSymbolizer::SymbolResolved(sym_util::ProcessId process_id,
+                                          base::Time time,
+                                          sym_util::Address address,
+                                          Handle handle,
+                                          const sym_util::Symbol& symbol) {
+  PendingMap::iterator it(pending_.find(handle));
+  if (it == pending_.end())
+    return;
+
+  size_t count = it->second;
+  pending_.erase(it);
+
+  AddSamples(process_id,
+             symbol.module.empty() ? kUnknown : symbol.module,
+             symbol.name.empty() ? kUnknown : symbol.name,
+             count);
+
+  if (pending_.empty())
+    Complete();
+}
+
+void CpuProfileSymbolizer::AddSamples(sym_util::ProcessId process_id,
+                                      const std::wstring& module,
+                                      const std::wstring& function,
+                                      size_t count) {
+  functions_[std::make_pair(process_id, std::make_pair(module, function))] +=
+      count;
+}
+
+void CpuProfileSymbolizer::Complete() {
+  DCHECK(pending_.empty());
+
+  SymbolSampleList functions;
+  SymbolSampleList modules;
+  functions.reserve(functions_.size());
+
+  FunctionCounts::const_iterator it(functions_.begin());
+  for (; it != functions_.end(); ++it) {
+    SymbolSamples function_samples;
+    function_samples.process_id = it->first.first;
+    function_samples.module = it->first.second.first;
+    function_samples.function = it->first.second.second;
+    function_samples.count = it->second;
+    functions.push_back(function_samples);
+
+    // The functions are ordered by process and module, so the functions of
+    // a module are adjacent.
+    if (modules.empty() ||
+        modules.back().process_id != function_samples.process_id ||
+        modules.back().module != function_samples.module) {
+      function_samples.function.clear();
+      modules.push_back(function_samples);
+    } else {
+      modules.back().count += function_samples.count;
+    }
+  }
+
+  std::sort(functions.begin(), functions.end(), HasMoreSymbolSamples);
+  std::sort(modules.begin(), modules.end(), HasMoreSymbolSamples);
+
+  // The callback may start another symbolization.
+  CompletionCallback callback(callback_);
+  functions_.clear();
+  callback_.Reset();
+
+  if (!callback.is_null())
+    callback.Run(functions, modules);
+}
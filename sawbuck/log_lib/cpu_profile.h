@@ -0,0 +1,185 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// CPU profile declaration.
+#ifndef SAWBUCK_LOG_LIB_CPU_PROFILE_H_
+#define SAWBUCK_LOG_LIB_CPU_PROFILE_H_
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "base/callback.h"
+#include "base/hash_tables.h"
+#include "base/synchronization/lock.h"
+#include "base/time.h"
+#include "sawbuck/log_lib/kernel_log_consumer.h"
+#include "sawbuck/log_lib/symbol_lookup_service.h"
+
+// The CPU profile of a kernel log: the instruction addresses sampled in
+// each process, counted in time buckets, so that the hot spots of any time
+// range of the log can be retrieved without revisiting the samples.
+// Samples are added on the kernel consumer thread, and the profile may be
+// queried concurrently from any other thread.
+class CpuProfile : public KernelProfileEvents {
+ public:
+  // The samples of an address in a process.
+  struct AddressSamples {
+    sym_util::ProcessId process_id;
+    sym_util::Address address;
+    // The time of the first sample, which is when we symbolize the address.
+    base::Time first_time;
+    size_t count;
+  };
+  typedef std::vector<AddressSamples> AddressSampleList;
+
+  // @param resolution the time granularity of range queries.
+  explicit CpuProfile(base::TimeDelta resolution);
+  ~CpuProfile();
+
+  // Retrieves the addresses sampled in a time range.
+  // @param start the start of the time range.
+  // @param end the end of the time range, exclusive.
+  // @param samples returns the addresses sampled in the buckets overlapping
+  //     [start, end), in descending order of count.
+  // @returns the total number of samples retrieved.
+  size_t GetAddressSamples(const base::Time& start,
+                           const base::Time& end,
+                           AddressSampleList* samples) const;
+
+  // Discards all samples.
+  void Clear();
+
+  // @returns the number of samples in the profile.
+  size_t total_samples() const;
+
+  // KernelProfileEvents implementation.
+  virtual void OnSampledProfile(DWORD process_id,
+                                DWORD thread_id,
+                                const base::Time& time,
+                                sym_util::Address instruction_pointer,
+                                ULONG count);
+
+ private:
+  struct Counter {
+    Counter() : count(0) {
+    }
+
+    base::Time first_time;
+    size_t count;
+  };
+  typedef base::hash_map<sym_util::Address, Counter> AddressCounters;
+  typedef std::map<sym_util::ProcessId, AddressCounters> ProcessCounters;
+  // Keyed on the time of the bucket, in units of the resolution.
+  typedef std::map<int64, ProcessCounters> BucketMap;
+
+  // @returns the bucket key for @p time.
+  int64 GetBucket(const base::Time& time) const;
+
+  mutable base::Lock lock_;
+  BucketMap buckets_;  // Under lock_.
+  size_t total_samples_;  // Under lock_.
+
+  // The counters of the last sample. Consecutive samples mostly fall in the
+  // same bucket and process, which saves the map lookups for them.
+  int64 last_bucket_;  // Under lock_.
+  sym_util::ProcessId last_process_id_;  // Under lock_.
+  AddressCounters* last_counters_;  // Under lock_.
+
+  const base::TimeDelta resolution_;
+
+  DISALLOW_COPY_AND_ASSIGN(CpuProfile);
+};
+
+// Symbolizes the address samples of a CPU profile through a symbol lookup
+// service, and sums them up into the functions and modules of each process.
+// All the addresses are enqueued at once, which lets the lookup service
+// resolve them in a single batch on its background thread.
+class CpuProfileSymbolizer {
+ public:
+  // The samples of a function, or of a whole module, in a process.
+  struct SymbolSamples {
+    sym_util::ProcessId process_id;
+    std::wstring module;
+    // Empty for the samples of a whole module.
+    std::wstring function;
+    size_t count;
+  };
+  typedef std::vector<SymbolSamples> SymbolSampleList;
+
+  // Invoked with the functions and the modules sampled, in descending order
+  // of count.
+  typedef base::Callback<void(const SymbolSampleList& functions,
+                              const SymbolSampleList& modules)>
+      CompletionCallback;
+
+  // The most addresses we resolve per symbolization. The remaining, least
+  // sampled, addresses are counted as unknown.
+  static const size_t kMaxResolvedAddresses = 4096;
+
+  // The module and function name of the samples we can't symbolize.
+  static const wchar_t kUnknown[];
+
+  // @param lookup_service the lookup service to symbolize with, which
+  //     must outlive this object.
+  explicit CpuProfileSymbolizer(ISymbolLookupService* lookup_service);
+  ~CpuProfileSymbolizer();
+
+  // Starts symbolizing @p samples, cancelling any pending symbolization.
+  // @param samples the samples to symbolize.
+  // @param callback invoked on the foreground thread of the lookup service
+  //     once all the samples are symbolized. This may happen before this
+  //     function returns, if there's nothing to resolve.
+  void Symbolize(const CpuProfile::AddressSampleList& samples,
+                 const CompletionCallback& callback);
+
+  // Cancels the pending symbolization, if any.
+  void Cancel();
+
+  // @returns true iff a symbolization is pending.
+  bool pending() const { return !pending_.empty(); }
+
+ private:
+  typedef ISymbolLookupService::Handle Handle;
+  // A function as (process id, (module, function)).
+  typedef std::pair<sym_util::ProcessId,
+                    std::pair<std::wstring, std::wstring> > FunctionKey;
+  typedef std::map<FunctionKey, size_t> FunctionCounts;
+  // The sample counts of the pending requests.
+  typedef std::map<Handle, size_t> PendingMap;
+
+  void SymbolResolved(sym_util::ProcessId process_id,
+                      base::Time time,
+                      sym_util::Address address,
+                      Handle handle,
+                      const sym_util::Symbol& symbol);
+
+  // Adds @p count samples to the function @p function of @p module.
+  void AddSamples(sym_util::ProcessId process_id,
+                  const std::wstring& module,
+                  const std::wstring& function,
+                  size_t count);
+
+  // Sorts the function counts and issues the completion callback.
+  void Complete();
+
+  ISymbolLookupService* lookup_service_;
+  CompletionCallback callback_;
+  PendingMap pending_;
+  FunctionCounts functions_;
+
+  DISALLOW_COPY_AND_ASSIGN(CpuProfileSymbolizer);
+};
+
+#endif  // SAWBUCK_LOG_LIB_CPU_PROFILE_H_
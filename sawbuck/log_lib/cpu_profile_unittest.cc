@@ -0,0 +1,267 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// CPU profile unittests.
+#include "sawbuck/log_lib/cpu_profile.h"
+
+#include "base/bind.h"
+#include "base/stringprintf.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+const DWORD kPid1 = 0x42;
+const DWORD kPid2 = 0x99;
+const DWORD kTid = 7;
+
+// A lookup service that resolves its requests on demand, to the module and
+// function named by the high and low halves of the address.
+class FakeSymbolLookupService : public ISymbolLookupService {
+ public:
+  FakeSymbolLookupService() : next_handle_(0), fail_requests_(false) {
+  }
+
+  virtual Handle ResolveAddress(sym_util::ProcessId process_id,
+                                const base::Time& time,
+                                sym_util::Address address,
+                                const SymbolResolvedCallback& callback) {
+    if (fail_requests_)
+      return kInvalidHandle;
+
+    Request request = { process_id, time, address, callback };
+    requests_[next_handle_] = request;
+    return next_handle_++;
+  }
+
+  virtual void CancelRequest(Handle request_handle) {
+    requests_.erase(request_handle);
+  }
+
+  virtual void SetSymbolPath(const wchar_t* symbol_path) {
+  }
+
+  void ResolveAll() {
+    RequestMap requests;
+    requests.swap(requests_);
+
+    RequestMap::const_iterator it(requests.begin());
+    for (; it != requests.end(); ++it) {
+      const Request& request = it->second;
+      sym_util::Symbol symbol;
+      if (request.address != 0) {
+        symbol.module = base::StringPrintf(L"m%llx", request.address >> 16);
+        symbol.name = base::StringPrintf(L"f%llx", request.address & 0xFF00);
+      }
+      request.callback.Run(request.process_id, request.time, request.address,
+                           it->first, symbol);
+    }
+  }
+
+  size_t num_requests() const { return requests_.size(); }
+  void set_fail_requests(bool fail_requests) {
+    fail_requests_ = fail_requests;
+  }
+
+ private:
+  struct Request {
+    sym_util::ProcessId process_id;
+    base::Time time;
+    sym_util::Address address;
+    SymbolResolvedCallback callback;
+  };
+  typedef std::map<Handle, Request> RequestMap;
+
+  RequestMap requests_;
+  Handle next_handle_;
+  bool fail_requests_;
+};
+
+class CpuProfileTest : public testing::Test {
+ public:
+  CpuProfileTest()
+      : profile_(base::TimeDelta::FromSeconds(1)),
+        symbolizer_(&lookup_service_),
+        t0_(base::Time::FromInternalValue(1000000000)),
+        completions_(0) {
+  }
+
+  void AddSample(DWORD pid, int64 ms, sym_util::Address address) {
+    profile_.OnSampledProfile(pid, kTid,
+        t0_ + base::TimeDelta::FromMilliseconds(ms), address, 1);
+  }
+
+  size_t GetSamples(int64 start_ms, int64 end_ms) {
+    return profile_.GetAddressSamples(
+        t0_ + base::TimeDelta::FromMilliseconds(start_ms),
+        t0_ + base::TimeDelta::FromMilliseconds(end_ms),
+        &samples_);
+  }
+
+  void Symbolized(const CpuProfileSymbolizer::SymbolSampleList& functions,
+                  const CpuProfileSymbolizer::SymbolSampleList& modules) {
+    ++completions_;
+    functions_ = functions;
+    modules_ = modules;
+  }
+
+  CpuProfileSymbolizer::CompletionCallback symbolized_callback() {
+    return base::Bind(&CpuProfileTest::Symbolized, base::Unretained(this));
+  }
+
+ protected:
+  CpuProfile profile_;
+  FakeSymbolLookupService lookup_service_;
+  CpuProfileSymbolizer symbolizer_;
+  const base::Time t0_;
+
+  CpuProfile::AddressSampleList samples_;
+  size_t completions_;
+  CpuProfileSymbolizer::SymbolSampleList functions_;
+  CpuProfileSymbolizer::SymbolSampleList modules_;
+};
+
+}  // namespace
+
+TEST_F(CpuProfileTest, AddressSamples) {
+  EXPECT_EQ(0U, GetSamples(0, 10000));
+  EXPECT_TRUE(samples_.empty());
+
+  AddSample(kPid1, 100, 0x10001000);
+  AddSample(kPid1, 200, 0x10001000);
+  AddSample(kPid2, 300, 0x10001000);
+  AddSample(kPid1, 1100, 0x10002000);
+  AddSample(kPid1, 1200, 0x10001000);
+  AddSample(kPid1, 2500, 0x10002000);
+  EXPECT_EQ(6U, profile_.total_samples());
+
+  // All the samples, most sampled first.
+  ASSERT_EQ(6U, GetSamples(0, 3000));
+  ASSERT_EQ(3U, samples_.size());
+  EXPECT_EQ(kPid1, samples_[0].process_id);
+  EXPECT_EQ(0x10001000U, samples_[0].address);
+  EXPECT_EQ(3U, samples_[0].count);
+  EXPECT_TRUE(t0_ + base::TimeDelta::FromMilliseconds(100) ==
+              samples_[0].first_time);
+  EXPECT_EQ(kPid1, samples_[1].process_id);
+  EXPECT_EQ(0x10002000U, samples_[1].address);
+  EXPECT_EQ(2U, samples_[1].count);
+  EXPECT_EQ(kPid2, samples_[2].process_id);
+  EXPECT_EQ(1U, samples_[2].count);
+
+  // The second bucket alone.
+  ASSERT_EQ(2U, GetSamples(1000, 2000));
+  ASSERT_EQ(2U, samples_.size());
+  EXPECT_EQ(1U, samples_[0].count);
+  EXPECT_EQ(1U, samples_[1].count);
+  EXPECT_TRUE(t0_ + base::TimeDelta::FromMilliseconds(1200) ==
+              samples_[0].first_time);
+
+  // Ranges are rounded out to the buckets they overlap.
+  EXPECT_EQ(5U, GetSamples(500, 1001));
+  EXPECT_EQ(1U, GetSamples(2999, 5000));
+  EXPECT_EQ(0U, GetSamples(3000, 5000));
+
+  profile_.Clear();
+  EXPECT_EQ(0U, profile_.total_samples());
+  EXPECT_EQ(0U, GetSamples(0, 3000));
+}
+
+TEST_F(CpuProfileTest, Symbolize) {
+  AddSample(kPid1, 100, 0x10001000);
+  AddSample(kPid1, 200, 0x10001010);
+  AddSample(kPid1, 300, 0x10002000);
+  AddSample(kPid1, 400, 0x20001000);
+  AddSample(kPid2, 500, 0x10001000);
+  AddSample(kPid2, 600, 0);
+  ASSERT_EQ(6U, GetSamples(0, 1000));
+
+  symbolizer_.Symbolize(samples_, symbolized_callback());
+  EXPECT_TRUE(symbolizer_.pending());
+  EXPECT_EQ(samples_.size(), lookup_service_.num_requests());
+  EXPECT_EQ(0U, completions_);
+
+  lookup_service_.ResolveAll();
+  EXPECT_FALSE(symbolizer_.pending());
+  ASSERT_EQ(1U, completions_);
+
+  // The two addresses of f1000 in m1000 sum up.
+  ASSERT_EQ(5U, functions_.size());
+  EXPECT_EQ(kPid1, functions_[0].process_id);
+  EXPECT_EQ(L"m1000", functions_[0].module);
+  EXPECT_EQ(L"f1000", functions_[0].function);
+  EXPECT_EQ(2U, functions_[0].count);
+  for (size_t i = 1; i < functions_.size(); ++i)
+    EXPECT_EQ(1U, functions_[i].count);
+  EXPECT_EQ(CpuProfileSymbolizer::kUnknown, functions_[3].function);
+
+  ASSERT_EQ(4U, modules_.size());
+  EXPECT_EQ(kPid1, modules_[0].process_id);
+  EXPECT_EQ(L"m1000", modules_[0].module);
+  EXPECT_TRUE(modules_[0].function.empty());
+  EXPECT_EQ(3U, modules_[0].count);
+}
+
+TEST_F(CpuProfileTest, SymbolizeCancel) {
+  AddSample(kPid1, 100, 0x10001000);
+  ASSERT_EQ(1U, GetSamples(0, 1000));
+
+  symbolizer_.Symbolize(samples_, symbolized_callback());
+  EXPECT_EQ(1U, lookup_service_.num_requests());
+  symbolizer_.Cancel();
+  EXPECT_FALSE(symbolizer_.pending());
+  EXPECT_EQ(0U, lookup_service_.num_requests());
+
+  // A new symbolization cancels the previous one.
+  symbolizer_.Symbolize(samples_, symbolized_callback());
+  symbolizer_.Symbolize(samples_, symbolized_callback());
+  EXPECT_EQ(1U, lookup_service_.num_requests());
+  lookup_service_.ResolveAll();
+  EXPECT_EQ(1U, completions_);
+}
+
+TEST_F(CpuProfileTest, SymbolizeFailures) {
+  AddSample(kPid1, 100, 0x10001000);
+  AddSample(kPid1, 200, 0x10002000);
+  ASSERT_EQ(2U, GetSamples(0, 1000));
+
+  // Failed requests count as unknown, and complete synchronously.
+  lookup_service_.set_fail_requests(true);
+  symbolizer_.Symbolize(samples_, symbolized_callback());
+  EXPECT_FALSE(symbolizer_.pending());
+  ASSERT_EQ(1U, completions_);
+  ASSERT_EQ(1U, functions_.size());
+  EXPECT_EQ(CpuProfileSymbolizer::kUnknown, functions_[0].module);
+  EXPECT_EQ(CpuProfileSymbolizer::kUnknown, functions_[0].function);
+  EXPECT_EQ(2U, functions_[0].count);
+
+  // As do the samples beyond the most we resolve.
+  lookup_service_.set_fail_requests(false);
+  CpuProfile::AddressSampleList samples;
+  for (size_t i = 0; i < CpuProfileSymbolizer::kMaxResolvedAddresses + 2;
+       ++i) {
+    CpuProfile::AddressSamples address_samples = {
+        kPid1, 0x10000000 + i % 0x100, t0_, 1 };
+    samples.push_back(address_samples);
+  }
+  symbolizer_.Symbolize(samples, symbolized_callback());
+  EXPECT_EQ(CpuProfileSymbolizer::kMaxResolvedAddresses,
+            lookup_service_.num_requests());
+  lookup_service_.ResolveAll();
+  ASSERT_EQ(2U, completions_);
+  ASSERT_EQ(2U, functions_.size());
+  EXPECT_EQ(L"f0", functions_[0].function);
+  EXPECT_EQ(CpuProfileSymbolizer::kMaxResolvedAddresses, functions_[0].count);
+  EXPECT_EQ(CpuProfileSymbolizer::kUnknown, functions_[1].function);
+  EXPECT_EQ(2U, functions_[1].count);
+}
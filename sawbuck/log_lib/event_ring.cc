@@ -0,0 +1,68 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Event ring implementation.
+#include "sawbuck/log_lib/event_ring.h"
+
+#include "base/logging.h"
+
+EventRing::EventRing(size_t capacity)
+    : slots_(capacity), push_count_(0), pop_count_(0) {
+  DCHECK(capacity != 0 && (capacity & (capacity - 1)) == 0);
+}
+
+EventRing::~EventRing() {
+}
+
+bool EventRing::Push(const EVENT_TRACE* event) {
+  DCHECK(event != NULL);
+
+  uint32 push_count = base::subtle::NoBarrier_Load(&push_count_);
+  uint32 pop_count = base::subtle::Acquire_Load(&pop_count_);
+  if (push_count - pop_count == slots_.size())
+    return false;
+
+  Slot& slot = GetSlot(push_count);
+  slot.event = *event;
+  const uint8* data = reinterpret_cast<const uint8*>(event->MofData);
+  slot.data.assign(data, data + event->MofLength);
+  slot.event.MofData = slot.data.empty() ? NULL : &slot.data[0];
+
+  // Publish the event to the consumer.
+  base::subtle::Release_Store(&push_count_, push_count + 1);
+  return true;
+}
+
+EVENT_TRACE* EventRing::Front() {
+  uint32 pop_count = base::subtle::NoBarrier_Load(&pop_count_);
+  uint32 push_count = base::subtle::Acquire_Load(&push_count_);
+  if (pop_count == push_count)
+    return NULL;
+
+  return &GetSlot(pop_count).event;
+}
+
+void EventRing::Pop() {
+  DCHECK_NE(0U, size());
+
+  // Hand the slot back to the producer.
+  uint32 pop_count = base::subtle::NoBarrier_Load(&pop_count_);
+  base::subtle::Release_Store(&pop_count_, pop_count + 1);
+}
+
+size_t EventRing::size() const {
+  uint32 pop_count = base::subtle::Acquire_Load(&pop_count_);
+  uint32 push_count = base::subtle::Acquire_Load(&push_count_);
+  return push_count - pop_count;
+}
@@ -0,0 +1,76 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Event ring declaration.
+#ifndef SAWBUCK_LOG_LIB_EVENT_RING_H_
+#define SAWBUCK_LOG_LIB_EVENT_RING_H_
+
+#include <windows.h>
+#include <wmistr.h>
+#include <evntrace.h>
+#include <vector>
+#include "base/atomicops.h"
+#include "base/basictypes.h"
+
+// A fixed capacity ring of event copies, handed off from a single producer
+// thread to a single consumer thread without locking. The slots and their
+// data buffers are reused, so once the ring has warmed up, pushing an event
+// costs a copy of its data.
+class EventRing {
+ public:
+  // @param capacity the number of events the ring can hold, which must be a
+  //     power of two.
+  explicit EventRing(size_t capacity);
+  ~EventRing();
+
+  // Copies an event into the ring. This must only be called by the producer.
+  // @param event the event to copy.
+  // @returns false if the ring is full, in which case the event is dropped.
+  bool Push(const EVENT_TRACE* event);
+
+  // Returns the oldest event in the ring, or NULL if the ring is empty. The
+  // event stays valid until it's popped. This must only be called by the
+  // consumer.
+  EVENT_TRACE* Front();
+
+  // Removes the oldest event from the ring, which must not be empty. This
+  // must only be called by the consumer.
+  void Pop();
+
+  // Returns the number of events in the ring. This is only a snapshot when
+  // read from the producer or the consumer while the other one is running.
+  size_t size() const;
+
+  size_t capacity() const { return slots_.size(); }
+
+ private:
+  struct Slot {
+    EVENT_TRACE event;
+    std::vector<uint8> data;
+  };
+
+  // Returns the slot at position @p count.
+  Slot& GetSlot(uint32 count) { return slots_[count & (slots_.size() - 1)]; }
+
+  std::vector<Slot> slots_;
+
+  // The number of events pushed and popped so far, which wrap around. Each
+  // is written by its own thread only, and published to the other one.
+  volatile base::subtle::Atomic32 push_count_;
+  volatile base::subtle::Atomic32 pop_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(EventRing);
+};
+
+#endif  // SAWBUCK_LOG_LIB_EVENT_RING_H_
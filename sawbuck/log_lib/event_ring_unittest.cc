@@ -0,0 +1,115 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Event ring unittests.
+#include "sawbuck/log_lib/event_ring.h"
+
+#include "base/threading/simple_thread.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+// Initializes @p event to carry @p value as its data.
+void InitEvent(DWORD* value, EVENT_TRACE* event) {
+  memset(event, 0, sizeof(*event));
+  event->Header.ThreadId = *value;
+  event->MofData = value;
+  event->MofLength = sizeof(*value);
+}
+
+DWORD GetEventValue(const EVENT_TRACE* event) {
+  EXPECT_EQ(sizeof(DWORD), event->MofLength);
+  return *reinterpret_cast<const DWORD*>(event->MofData);
+}
+
+// Pushes a sequence of values into a ring, spinning while it's full.
+class Producer : public base::DelegateSimpleThread::Delegate {
+ public:
+  Producer(EventRing* ring, DWORD count) : ring_(ring), count_(count) {
+  }
+
+  virtual void Run() {
+    for (DWORD i = 0; i < count_; ++i) {
+      DWORD value = i;
+      EVENT_TRACE event;
+      InitEvent(&value, &event);
+      while (!ring_->Push(&event))
+        ::Sleep(0);
+    }
+  }
+
+ private:
+  EventRing* ring_;
+  DWORD count_;
+};
+
+TEST(EventRingTest, PushAndPop) {
+  EventRing ring(4);
+  EXPECT_EQ(4U, ring.capacity());
+  EXPECT_EQ(0U, ring.size());
+  EXPECT_TRUE(ring.Front() == NULL);
+
+  // Go around the ring a few times.
+  DWORD next_push = 0;
+  DWORD next_pop = 0;
+  for (size_t i = 0; i < 5; ++i) {
+    for (; ring.size() < ring.capacity(); ++next_push) {
+      DWORD value = next_push;
+      EVENT_TRACE event;
+      InitEvent(&value, &event);
+      ASSERT_TRUE(ring.Push(&event));
+
+      // The event data is copied.
+      value = 0xFFFFFFFF;
+    }
+
+    DWORD value = next_push;
+    EVENT_TRACE event;
+    InitEvent(&value, &event);
+    EXPECT_FALSE(ring.Push(&event));
+    EXPECT_EQ(4U, ring.size());
+
+    for (size_t j = 0; j < 3; ++j, ++next_pop) {
+      EVENT_TRACE* front = ring.Front();
+      ASSERT_TRUE(front != NULL);
+      EXPECT_EQ(next_pop, front->Header.ThreadId);
+      EXPECT_EQ(next_pop, GetEventValue(front));
+      ring.Pop();
+    }
+    EXPECT_EQ(1U, ring.size());
+  }
+}
+
+TEST(EventRingTest, ConcurrentProducer) {
+  const DWORD kEventCount = 100000;
+  EventRing ring(64);
+  Producer producer(&ring, kEventCount);
+  base::DelegateSimpleThread thread(&producer, "EventRingTest producer");
+  thread.Start();
+
+  for (DWORD i = 0; i < kEventCount; ++i) {
+    EVENT_TRACE* event = ring.Front();
+    while (event == NULL) {
+      ::Sleep(0);
+      event = ring.Front();
+    }
+    ASSERT_EQ(i, GetEventValue(event));
+    ring.Pop();
+  }
+
+  thread.Join();
+  EXPECT_EQ(0U, ring.size());
+}
+
+}  // namespace
@@ -226,6 +226,7 @@ bool KernelProcessEvents::ProcessInfo::operator == (
 
 KernelLogParser::KernelLogParser() : module_event_sink_(NULL),
     page_fault_event_sink_(NULL), process_event_sink_(NULL),
+    profile_event_sink_(NULL),
     infer_bitness_from_log_(true),
     is_64_bit_log_(false) {
 }
@@ -551,6 +552,48 @@ bool KernelLogParser::ProcessProcessEvent(EVENT_TRACE* event) {
   return false;
 }
 
+bool KernelLogParser::ProcessPerfInfoEvent(EVENT_TRACE* event) {
+  DCHECK(event && event->Header.Guid == kPerfInfoEventClass);
+
+  if (profile_event_sink_ == NULL)
+    return false;
+
+  if (event->Header.Class.Type != kSampledProfileEvent)
+    return false;
+
+  base::Time time(base::Time::FromFileTime(
+      reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
+
+  BinaryBufferReader reader(event->MofData, event->MofLength);
+  if (is_64_bit_log()) {
+    const SampledProfile64V2* data = NULL;
+    if (!reader.Read(&data)) {
+      LOG(ERROR) << "Short sampled profile event";
+      return false;
+    }
+
+    profile_event_sink_->OnSampledProfile(event->Header.ProcessId,
+                                          data->ThreadId,
+                                          time,
+                                          data->InstructionPointer,
+                                          data->Count);
+  } else {
+    const SampledProfile32V2* data = NULL;
+    if (!reader.Read(&data)) {
+      LOG(ERROR) << "Short sampled profile event";
+      return false;
+    }
+
+    profile_event_sink_->OnSampledProfile(event->Header.ProcessId,
+                                          data->ThreadId,
+                                          time,
+                                          data->InstructionPointer,
+                                          data->Count);
+  }
+
+  return true;
+}
+
 bool KernelLogParser::ProcessOneEvent(EVENT_TRACE* event) {
   if (event->Header.Guid == kImageLoadEventClass) {
     return ProcessImageLoadEvent(event);
@@ -558,6 +601,8 @@ bool KernelLogParser::ProcessOneEvent(EVENT_TRACE* event) {
     return ProcessPageFaultEvent(event);
   } else if (event->Header.Guid == kProcessEventClass) {
     return ProcessProcessEvent(event);
+  } else if (event->Header.Guid == kPerfInfoEventClass) {
+    return ProcessPerfInfoEvent(event);
   } else if (event->Header.Guid == kEventTraceEventClass) {
     if (event->Header.Class.Type == kLogFileHeaderEvent) {
       LogFileHeader32* data =
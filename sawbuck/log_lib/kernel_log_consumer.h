@@ -115,6 +115,23 @@ class KernelProcessEvents {
   // TODO(siggi): Data collection end event?
 };
 
+// Implemented by clients of the kernel log parser to get the CPU samples
+// logged by the sampling profiler of the kernel.
+class KernelProfileEvents {
+ public:
+  // Issued for each sampled profile event.
+  // @param process_id the process id from the event header.
+  // @param thread_id the thread that was interrupted by the sample.
+  // @param time the time of the sample.
+  // @param instruction_pointer the sampled instruction address.
+  // @param count the number of samples this event stands for.
+  virtual void OnSampledProfile(DWORD process_id,
+                                DWORD thread_id,
+                                const base::Time& time,
+                                sym_util::Address instruction_pointer,
+                                ULONG count) = 0;
+};
+
 class KernelLogParser {
  public:
   KernelLogParser();
@@ -139,6 +156,9 @@ class KernelLogParser {
   void set_process_event_sink(KernelProcessEvents* process_event_sink) {
     process_event_sink_ = process_event_sink;
   }
+  void set_profile_event_sink(KernelProfileEvents* profile_event_sink) {
+    profile_event_sink_ = profile_event_sink;
+  }
 
   // Process an event, issue callbacks to event sinks as appropriate.
   // @param event the event to process.
@@ -149,6 +169,7 @@ class KernelLogParser {
   bool ProcessImageLoadEvent(EVENT_TRACE* event);
   bool ProcessPageFaultEvent(EVENT_TRACE* event);
   bool ProcessProcessEvent(EVENT_TRACE* event);
+  bool ProcessPerfInfoEvent(EVENT_TRACE* event);
 
   // Our module event sink.
   KernelModuleEvents* module_event_sink_;
@@ -156,6 +177,8 @@ class KernelLogParser {
   KernelPageFaultEvents* page_fault_event_sink_;
   // Our process event sink.
   KernelProcessEvents* process_event_sink_;
+  // Our CPU sample event sink.
+  KernelProfileEvents* profile_event_sink_;
 
   // If true, we should infer the log bitness from the event stream,
   // e.g. from the pointer size field of the log file header event.
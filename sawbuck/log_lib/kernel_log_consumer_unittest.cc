@@ -19,6 +19,7 @@
 #include "base/path_service.h"
 #include "gtest/gtest.h"
 #include "gmock/gmock.h"
+#include "sawbuck/log_lib/kernel_log_types.h"
 #include "sawbuck/log_lib/kernel_log_unittest_data.h"
 
 namespace {
@@ -53,6 +54,15 @@ class MockKernelProcessEvents: public KernelProcessEvents{
                                      ULONG exit_status));
 };
 
+class MockKernelProfileEvents: public KernelProfileEvents {
+ public:
+  MOCK_METHOD5(OnSampledProfile, void(DWORD process_id,
+                                      DWORD thread_id,
+                                      const base::Time& time,
+                                      sym_util::Address instruction_pointer,
+                                      ULONG count));
+};
+
 class KernelLogConsumerTest: public testing::Test {
  public:
   KernelLogConsumerTest() {
@@ -220,4 +230,44 @@ TEST_F(KernelLogConsumerTest, ProcessEventsLog64Version3) {
   Consume(L"process_data_64_v3.etl");
 }
 
+TEST(KernelLogParserTest, SampledProfileEvents) {
+  kernel_log_types::SampledProfile32V2 data32 = { 0x01001234, 42, 1 };
+  EVENT_TRACE event = {};
+  event.Header.Guid = kernel_log_types::kPerfInfoEventClass;
+  event.Header.Class.Type = kernel_log_types::kSampledProfileEvent;
+  event.Header.Class.Version = 2;
+  event.Header.ProcessId = 7;
+  event.MofData = &data32;
+  event.MofLength = sizeof(data32);
+
+  KernelLogParser parser;
+  parser.set_infer_bitness_from_log(false);
+  parser.set_is_64_bit_log(false);
+
+  // The samples go unhandled without a sink.
+  EXPECT_FALSE(parser.ProcessOneEvent(&event));
+
+  StrictMock<MockKernelProfileEvents> profile_events;
+  parser.set_profile_event_sink(&profile_events);
+  EXPECT_CALL(profile_events, OnSampledProfile(7, 42, _, 0x01001234, 1))
+      .Times(1);
+  EXPECT_TRUE(parser.ProcessOneEvent(&event));
+
+  // Short events are rejected.
+  event.MofLength = sizeof(data32) - 1;
+  EXPECT_FALSE(parser.ProcessOneEvent(&event));
+
+  kernel_log_types::SampledProfile64V2 data64 = { 0x7FF012345678ULL, 43, 2 };
+  event.MofData = &data64;
+  event.MofLength = sizeof(data64);
+  parser.set_is_64_bit_log(true);
+  EXPECT_CALL(profile_events, OnSampledProfile(7, 43, _, 0x7FF012345678ULL, 2))
+      .Times(1);
+  EXPECT_TRUE(parser.ProcessOneEvent(&event));
+
+  // Other performance information events are ignored.
+  event.Header.Class.Type = kernel_log_types::kSampledProfileEvent + 1;
+  EXPECT_FALSE(parser.ProcessOneEvent(&event));
+}
+
 }  // namespace
@@ -294,6 +294,27 @@ struct ProcessInfo64V3 {
   // ImageFileName, ItemWString
 };
 
+// Performance information events, of which we only parse the CPU samples
+// logged when the kernel session enables EVENT_TRACE_FLAG_PROFILE.
+DEFINE_GUID(kPerfInfoEventClass,
+  0xce1dbfb4, 0x137e, 0x4da6, 0x87, 0xb0, 0x3f, 0x59, 0xaa, 0x10, 0x2c, 0xbc);
+
+enum {
+  kSampledProfileEvent = 46,
+};
+
+struct SampledProfile32V2 {
+  ULONG InstructionPointer;  // ItemPtr
+  ULONG ThreadId;  // ItemULong
+  ULONG Count;  // ItemULong
+};
+
+struct SampledProfile64V2 {
+  ULONGLONG InstructionPointer;  // ItemPtr
+  ULONG ThreadId;  // ItemULong
+  ULONG Count;  // ItemULong
+};
+
 }  // namespace kernel_log_types
 
 #endif  // SAWBUCK_LOG_LIB_KERNEL_LOG_TYPES_H_
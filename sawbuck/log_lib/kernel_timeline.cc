@@ -0,0 +1,104 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Kernel timeline implementation.
+#include "sawbuck/log_lib/kernel_timeline.h"
+
+KernelTimeline::KernelTimeline() {
+}
+
+KernelTimeline::~KernelTimeline() {
+}
+
+bool KernelTimeline::GetProcessModuleState(
+    DWORD process_id, const base::Time& time,
+    std::vector<ModuleInformation>* modules) {
+  DCHECK(modules != NULL);
+
+  base::AutoLock lock(module_lock_);
+  return module_cache_.GetProcessModuleState(process_id, time, modules);
+}
+
+KernelTimeline::ModuleLoadStateId KernelTimeline::GetModuleLoadStateId(
+    DWORD process_id, const base::Time& time) {
+  base::AutoLock lock(module_lock_);
+  return module_cache_.GetStateId(process_id, time);
+}
+
+void KernelTimeline::OnModuleIsLoaded(
+    DWORD process_id, const base::Time& time,
+    const ModuleInformation& module_info) {
+  // This is a notification of a module that was loaded at the time
+  // logging was started. Instead of recording the event's issue time as
+  // the load time, we instead pretend the module was loaded from the
+  // beginning of time, which it might as well have been from our
+  // perspective.
+  // Note: on a system running the usual complement of processes and
+  // services, the OnModuleIsLoaded notification events have been
+  // observed to lag the starting time of the trace by minutes.
+  return OnModuleLoad(process_id, base::Time(), module_info);
+}
+
+void KernelTimeline::OnModuleUnload(
+    DWORD process_id, const base::Time& time,
+    const ModuleInformation& module_info) {
+  base::AutoLock lock(module_lock_);
+  module_cache_.ModuleUnloaded(process_id, time, module_info);
+}
+
+void KernelTimeline::OnModuleLoad(
+    DWORD process_id, const base::Time& time,
+    const ModuleInformation& module_info) {
+  std::wstring file_path(module_info.image_file_name);
+  // Map device paths to drive paths.
+  DWORD drives = ::GetLogicalDrives();
+  char drive = 'A';
+  for (; drives != 0; drives >>= 1, ++drive) {
+    if (drives & 1) {
+      wchar_t device_path[1024] = {};
+      wchar_t device[] = { drive, L':', L'\0' };
+      if (::QueryDosDevice(device, device_path, arraysize(device_path)) &&
+          file_path.find(device_path) == 0) {
+        std::wstring new_path = device;
+        new_path += file_path.substr(wcslen(device_path));
+        file_path = new_path;
+      }
+    }
+  }
+
+  ModuleInformation info(module_info);
+  info.image_file_name = file_path;
+
+  base::AutoLock lock(module_lock_);
+  module_cache_.ModuleLoaded(process_id, time, info);
+}
+
+void KernelTimeline::OnProcessIsRunning(const base::Time& time,
+    const KernelProcessEvents::ProcessInfo& process_info) {
+  process_info_.OnProcessIsRunning(time, process_info);
+}
+
+void KernelTimeline::OnProcessStarted(const base::Time& time,
+    const KernelProcessEvents::ProcessInfo& process_info) {
+  process_info_.OnProcessStarted(time, process_info);
+}
+
+void KernelTimeline::OnProcessEnded(const base::Time& time,
+    const KernelProcessEvents::ProcessInfo& process_info,
+    ULONG exit_status) {
+  process_info_.OnProcessEnded(time, process_info, exit_status);
+
+  base::AutoLock lock(module_lock_);
+  module_cache_.ProcessEnded(process_info.process_id, time);
+}
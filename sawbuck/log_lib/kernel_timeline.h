@@ -0,0 +1,90 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Kernel timeline declaration.
+#ifndef SAWBUCK_LOG_LIB_KERNEL_TIMELINE_H_
+#define SAWBUCK_LOG_LIB_KERNEL_TIMELINE_H_
+
+#include <vector>
+#include "base/synchronization/lock.h"
+#include "sawbuck/log_lib/kernel_log_consumer.h"
+#include "sawbuck/log_lib/process_info_service.h"
+#include "sawbuck/sym_util/module_cache.h"
+
+// The timeline of the processes, and of the modules they load, recorded
+// from the NT kernel log. It sinks the module and process events of a
+// kernel log parser once, and answers point in time queries about them for
+// all its clients, e.g. symbolization and process information.
+//
+// The process lifetimes also scope the module states: a process has no
+// modules once it has ended, so a later process reusing its id doesn't
+// appear to have its modules.
+class KernelTimeline
+    : public KernelModuleEvents,
+      public KernelProcessEvents {
+ public:
+  typedef sym_util::ModuleCache::ModuleLoadStateId ModuleLoadStateId;
+
+  KernelTimeline();
+  ~KernelTimeline();
+
+  // @returns the process information recorded in the timeline.
+  IProcessInfoService* process_info() { return &process_info_; }
+
+  // Retrieves the modules loaded in a process at a time.
+  // @param process_id the process to query.
+  // @param time the time to query.
+  // @param modules on success, returns the modules loaded.
+  // @returns true iff the process had any modules loaded at @p time.
+  bool GetProcessModuleState(DWORD process_id,
+                             const base::Time& time,
+                             std::vector<ModuleInformation>* modules);
+
+  // @returns an id that differs for any two different module load states,
+  //     but is shared by processes with the same modules loaded.
+  // @note the parameters are as for GetProcessModuleState.
+  ModuleLoadStateId GetModuleLoadStateId(DWORD process_id,
+                                         const base::Time& time);
+
+  // KernelModuleEvents implementation.
+  virtual void OnModuleIsLoaded(DWORD process_id,
+                                const base::Time& time,
+                                const ModuleInformation& module_info);
+  virtual void OnModuleUnload(DWORD process_id,
+                              const base::Time& time,
+                              const ModuleInformation& module_info);
+  virtual void OnModuleLoad(DWORD process_id,
+                            const base::Time& time,
+                            const ModuleInformation& module_info);
+
+  // KernelProcessEvents implementation.
+  virtual void OnProcessIsRunning(const base::Time& time,
+      const KernelProcessEvents::ProcessInfo& process_info);
+  virtual void OnProcessStarted(const base::Time& time,
+      const KernelProcessEvents::ProcessInfo& process_info);
+  virtual void OnProcessEnded(const base::Time& time,
+      const KernelProcessEvents::ProcessInfo& process_info,
+      ULONG exit_status);
+
+ private:
+  base::Lock module_lock_;
+  sym_util::ModuleCache module_cache_;  // Under module_lock_.
+
+  // The process lifetimes, which have their own lock.
+  ProcessInfoService process_info_;
+
+  DISALLOW_COPY_AND_ASSIGN(KernelTimeline);
+};
+
+#endif  // SAWBUCK_LOG_LIB_KERNEL_TIMELINE_H_
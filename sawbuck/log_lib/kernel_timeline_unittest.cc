@@ -0,0 +1,116 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Kernel timeline unittests.
+#include "sawbuck/log_lib/kernel_timeline.h"
+
+#include "gtest/gtest.h"
+
+namespace {
+
+const DWORD kPid = 0x42;
+const DWORD kParentPid = 0x99;
+const DWORD kSession = 1;
+const DWORD kExitCode = 33;
+
+class KernelTimelineTest : public testing::Test {
+ public:
+  KernelTimelineTest()
+      : t1_(base::Time::Now()),
+        t2_(t1_ + base::TimeDelta::FromSeconds(1)),
+        t3_(t2_ + base::TimeDelta::FromSeconds(1)),
+        t4_(t3_ + base::TimeDelta::FromSeconds(1)) {
+    foo_.base_address = 0x10000000;
+    foo_.module_size = 0x1000;
+    foo_.image_checksum = 0;
+    foo_.time_date_stamp = 0;
+    foo_.image_file_name = L"C:\\foo.dll";
+
+    bar_ = foo_;
+    bar_.image_file_name = L"C:\\bar.dll";
+  }
+
+  KernelProcessEvents::ProcessInfo Process(const wchar_t* command_line) {
+    KernelProcessEvents::ProcessInfo info = {
+        kPid,
+        kParentPid,
+        kSession,
+        {},  // user_sid
+        "foo.exe",
+        command_line,
+      };
+    return info;
+  }
+
+ protected:
+  KernelTimeline timeline_;
+  sym_util::ModuleInformation foo_;
+  sym_util::ModuleInformation bar_;
+  const base::Time t1_;
+  const base::Time t2_;
+  const base::Time t3_;
+  const base::Time t4_;
+};
+
+TEST_F(KernelTimelineTest, ModulesOfRunningProcesses) {
+  std::vector<sym_util::ModuleInformation> modules;
+  EXPECT_FALSE(timeline_.GetProcessModuleState(kPid, t1_, &modules));
+
+  // Modules loaded before the session started are there from the start.
+  timeline_.OnModuleIsLoaded(kPid, t2_, foo_);
+  timeline_.OnModuleLoad(kPid, t2_, bar_);
+
+  EXPECT_TRUE(timeline_.GetProcessModuleState(kPid, t1_, &modules));
+  ASSERT_EQ(1U, modules.size());
+  EXPECT_TRUE(foo_ == modules[0]);
+
+  EXPECT_TRUE(timeline_.GetProcessModuleState(kPid, t2_, &modules));
+  EXPECT_EQ(2U, modules.size());
+  EXPECT_NE(timeline_.GetModuleLoadStateId(kPid, t1_),
+            timeline_.GetModuleLoadStateId(kPid, t2_));
+
+  timeline_.OnModuleUnload(kPid, t3_, bar_);
+  EXPECT_EQ(timeline_.GetModuleLoadStateId(kPid, t1_),
+            timeline_.GetModuleLoadStateId(kPid, t3_));
+}
+
+TEST_F(KernelTimelineTest, ProcessIdReuse) {
+  timeline_.OnProcessStarted(t1_, Process(L"foo.exe first"));
+  timeline_.OnModuleLoad(kPid, t1_, foo_);
+  timeline_.OnProcessEnded(t2_, Process(L"foo.exe first"), kExitCode);
+
+  // The process had its modules until it ended.
+  std::vector<sym_util::ModuleInformation> modules;
+  EXPECT_TRUE(timeline_.GetProcessModuleState(kPid, t1_, &modules));
+  EXPECT_FALSE(timeline_.GetProcessModuleState(kPid, t2_, &modules));
+
+  // The next process to get the same id doesn't inherit them.
+  timeline_.OnProcessStarted(t3_, Process(L"foo.exe second"));
+  EXPECT_FALSE(timeline_.GetProcessModuleState(kPid, t3_, &modules));
+  timeline_.OnModuleLoad(kPid, t4_, bar_);
+  EXPECT_TRUE(timeline_.GetProcessModuleState(kPid, t4_, &modules));
+  ASSERT_EQ(1U, modules.size());
+  EXPECT_TRUE(bar_ == modules[0]);
+
+  // Both processes are in the process information.
+  IProcessInfoService::ProcessInfo info = {};
+  ASSERT_TRUE(timeline_.process_info()->GetProcessInfo(kPid, t1_, &info));
+  EXPECT_EQ(L"foo.exe first", info.command_line_);
+  EXPECT_EQ(kExitCode, info.exit_code_);
+  EXPECT_FALSE(timeline_.process_info()->GetProcessInfo(kPid, t2_, &info));
+  ASSERT_TRUE(timeline_.process_info()->GetProcessInfo(kPid, t4_, &info));
+  EXPECT_EQ(L"foo.exe second", info.command_line_);
+}
+
+}  // namespace
@@ -0,0 +1,317 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Log archive implementation.
+#include "sawbuck/log_lib/log_archive.h"
+
+#include <algorithm>
+#include "base/logging.h"
+#include "base/stringprintf.h"
+
+const wchar_t kLogArchiveExtension[] = L".sawlog";
+
+namespace {
+
+// The archive starts with this signature, including its terminating zero.
+const char kSignature[] = "Sawbuck log archive v1";
+
+// Each record starts with its type. All records start with the fields of
+// LogMessageBase, the stack trace addresses being stored as 64 bit values.
+// Log records go on with the repeat count, the line, the file and the
+// message. Trace records go on with the id, the name and the extra data.
+// Strings are stored as their length followed by their characters.
+enum RecordType {
+  LOG_RECORD = 1,
+  TRACE_BEGIN_RECORD,
+  TRACE_END_RECORD,
+  TRACE_INSTANT_RECORD,
+};
+
+// A stack trace deeper than this is taken for a corrupt archive.
+const uint32 kMaxTraceDepth = 1024;
+
+// A string longer than this is taken for a corrupt archive.
+const uint32 kMaxStringLength = 16 * 1024 * 1024;
+
+template <typename T>
+bool ReadValue(FILE* file, T* value) {
+  return fread(value, sizeof(*value), 1, file) == 1;
+}
+
+}  // namespace
+
+LogArchiveWriter::LogArchiveWriter(FILE* file)
+    : file_(file), failed_(false), collapsed_messages_(0) {
+  DCHECK(file != NULL);
+}
+
+LogArchiveWriter::~LogArchiveWriter() {
+  DCHECK_EQ(0U, pending_.repeat_count) << "Flush wasn't called.";
+}
+
+bool LogArchiveWriter::Init() {
+  Write(kSignature, sizeof(kSignature));
+  return !failed_;
+}
+
+bool LogArchiveWriter::Flush() {
+  WritePendingMessage();
+  if (fflush(file_) != 0)
+    failed_ = true;
+  return !failed_;
+}
+
+bool LogArchiveWriter::IsRepeat(const LogMessage& log_message) const {
+  return pending_.repeat_count != 0 &&
+      pending_.repeat_count != kuint32max &&
+      log_message.level == pending_.level &&
+      log_message.process_id == pending_.process_id &&
+      log_message.thread_id == pending_.thread_id &&
+      log_message.line == pending_.line &&
+      log_message.trace_depth == pending_.traces.size() &&
+      std::equal(pending_.traces.begin(), pending_.traces.end(),
+                 log_message.traces) &&
+      pending_.file.compare(0, std::string::npos,
+                            log_message.file, log_message.file_len) == 0 &&
+      pending_.message.compare(0, std::string::npos,
+                               log_message.message,
+                               log_message.message_len) == 0;
+}
+
+void LogArchiveWriter::OnLogMessage(const LogMessage& log_message) {
+  if (IsRepeat(log_message)) {
+    ++pending_.repeat_count;
+    ++collapsed_messages_;
+    return;
+  }
+
+  WritePendingMessage();
+
+  pending_.time = log_message.time;
+  pending_.level = log_message.level;
+  pending_.process_id = log_message.process_id;
+  pending_.thread_id = log_message.thread_id;
+  pending_.traces.assign(log_message.traces,
+                         log_message.traces + log_message.trace_depth);
+  pending_.file.assign(log_message.file, log_message.file_len);
+  pending_.line = log_message.line;
+  pending_.message.assign(log_message.message, log_message.message_len);
+  pending_.repeat_count = 1;
+}
+
+void LogArchiveWriter::OnTraceEventBegin(const TraceMessage& trace_message) {
+  WriteTraceMessage(TRACE_BEGIN_RECORD, trace_message);
+}
+
+void LogArchiveWriter::OnTraceEventEnd(const TraceMessage& trace_message) {
+  WriteTraceMessage(TRACE_END_RECORD, trace_message);
+}
+
+void LogArchiveWriter::OnTraceEventInstant(const TraceMessage& trace_message) {
+  WriteTraceMessage(TRACE_INSTANT_RECORD, trace_message);
+}
+
+void LogArchiveWriter::WritePendingMessage() {
+  if (pending_.repeat_count == 0)
+    return;
+
+  WriteRecordHeader(LOG_RECORD, pending_.time, pending_.level,
+                    pending_.process_id, pending_.thread_id,
+                    pending_.traces.size(),
+                    pending_.traces.empty() ? NULL : &pending_.traces[0]);
+  int32 line = pending_.line;
+  Write(&pending_.repeat_count, sizeof(pending_.repeat_count));
+  Write(&line, sizeof(line));
+  WriteString(pending_.file.data(), pending_.file.size());
+  WriteString(pending_.message.data(), pending_.message.size());
+  pending_.repeat_count = 0;
+}
+
+void LogArchiveWriter::WriteTraceMessage(uint8 type,
+                                         const TraceMessage& trace_message) {
+  // Keep the records in the order the messages came in.
+  WritePendingMessage();
+
+  WriteRecordHeader(type, trace_message.time, trace_message.level,
+                    trace_message.process_id, trace_message.thread_id,
+                    trace_message.trace_depth, trace_message.traces);
+  uint64 id = reinterpret_cast<uintptr_t>(trace_message.id);
+  Write(&id, sizeof(id));
+  WriteString(trace_message.name, trace_message.name_len);
+  WriteString(trace_message.extra, trace_message.extra_len);
+}
+
+void LogArchiveWriter::WriteRecordHeader(uint8 type,
+                                         base::Time time,
+                                         uint8 level,
+                                         uint32 process_id,
+                                         uint32 thread_id,
+                                         uint32 trace_depth,
+                                         void* const* traces) {
+  int64 time_value = time.ToInternalValue();
+  Write(&type, sizeof(type));
+  Write(&time_value, sizeof(time_value));
+  Write(&level, sizeof(level));
+  Write(&process_id, sizeof(process_id));
+  Write(&thread_id, sizeof(thread_id));
+  Write(&trace_depth, sizeof(trace_depth));
+  for (uint32 i = 0; i < trace_depth; ++i) {
+    uint64 address = reinterpret_cast<uintptr_t>(traces[i]);
+    Write(&address, sizeof(address));
+  }
+}
+
+void LogArchiveWriter::WriteString(const char* str, size_t len) {
+  uint32 length = len;
+  Write(&length, sizeof(length));
+  Write(str, len);
+}
+
+void LogArchiveWriter::Write(const void* data, size_t size) {
+  if (failed_ || size == 0)
+    return;
+
+  if (fwrite(data, size, 1, file_) != 1) {
+    LOG(ERROR) << "Failed to write to the log archive.";
+    failed_ = true;
+  }
+}
+
+LogArchiveReader::LogArchiveReader()
+    : log_event_sink_(NULL), trace_event_sink_(NULL) {
+}
+
+bool LogArchiveReader::Read(FILE* file) {
+  DCHECK(file != NULL);
+
+  char signature[sizeof(kSignature)] = {};
+  if (fread(signature, sizeof(signature), 1, file) != 1 ||
+      memcmp(signature, kSignature, sizeof(signature)) != 0) {
+    LOG(ERROR) << "Not a log archive.";
+    return false;
+  }
+
+  uint8 type = 0;
+  while (ReadValue(file, &type)) {
+    LogEvents::LogMessage log_message;
+    TraceEvents::TraceMessage trace_message;
+    LogMessageBase* message = &log_message;
+    if (type != LOG_RECORD)
+      message = &trace_message;
+    if (!ReadMessageBase(file, message))
+      return false;
+
+    std::string file_name;
+    std::string text;
+    std::string extra;
+    if (type == LOG_RECORD) {
+      uint32 repeat_count = 0;
+      int32 line = 0;
+      if (!ReadValue(file, &repeat_count) || !ReadValue(file, &line) ||
+          !ReadString(file, &file_name) || !ReadString(file, &text)) {
+        LOG(ERROR) << "Truncated log record.";
+        return false;
+      }
+
+      if (repeat_count > 1)
+        base::StringAppendF(&text, " (repeated %u times)", repeat_count);
+
+      log_message.line = line;
+      log_message.file = file_name.c_str();
+      log_message.file_len = file_name.size();
+      log_message.message = text.c_str();
+      log_message.message_len = text.size();
+      if (log_event_sink_ != NULL)
+        log_event_sink_->OnLogMessage(log_message);
+      continue;
+    }
+
+    uint64 id = 0;
+    if (!ReadValue(file, &id) || !ReadString(file, &text) ||
+        !ReadString(file, &extra)) {
+      LOG(ERROR) << "Truncated trace record.";
+      return false;
+    }
+
+    trace_message.id = reinterpret_cast<void*>(static_cast<uintptr_t>(id));
+    trace_message.name = text.c_str();
+    trace_message.name_len = text.size();
+    trace_message.extra = extra.c_str();
+    trace_message.extra_len = extra.size();
+    if (trace_event_sink_ == NULL)
+      continue;
+
+    switch (type) {
+      case TRACE_BEGIN_RECORD:
+        trace_event_sink_->OnTraceEventBegin(trace_message);
+        break;
+      case TRACE_END_RECORD:
+        trace_event_sink_->OnTraceEventEnd(trace_message);
+        break;
+      case TRACE_INSTANT_RECORD:
+        trace_event_sink_->OnTraceEventInstant(trace_message);
+        break;
+      default:
+        LOG(ERROR) << "Unknown record type " << static_cast<int>(type);
+        return false;
+    }
+  }
+
+  return feof(file) != 0;
+}
+
+bool LogArchiveReader::ReadMessageBase(FILE* file, LogMessageBase* message) {
+  DCHECK(message != NULL);
+
+  int64 time = 0;
+  uint8 level = 0;
+  uint32 process_id = 0;
+  uint32 thread_id = 0;
+  uint32 trace_depth = 0;
+  if (!ReadValue(file, &time) || !ReadValue(file, &level) ||
+      !ReadValue(file, &process_id) || !ReadValue(file, &thread_id) ||
+      !ReadValue(file, &trace_depth) || trace_depth > kMaxTraceDepth) {
+    LOG(ERROR) << "Truncated or corrupt record.";
+    return false;
+  }
+
+  traces_.resize(trace_depth);
+  for (uint32 i = 0; i < trace_depth; ++i) {
+    uint64 address = 0;
+    if (!ReadValue(file, &address)) {
+      LOG(ERROR) << "Truncated stack trace.";
+      return false;
+    }
+    traces_[i] = reinterpret_cast<void*>(static_cast<uintptr_t>(address));
+  }
+
+  message->time = base::Time::FromInternalValue(time);
+  message->level = level;
+  message->process_id = process_id;
+  message->thread_id = thread_id;
+  message->trace_depth = trace_depth;
+  message->traces = traces_.empty() ? NULL : &traces_[0];
+  return true;
+}
+
+bool LogArchiveReader::ReadString(FILE* file, std::string* str) {
+  DCHECK(str != NULL);
+
+  uint32 length = 0;
+  if (!ReadValue(file, &length) || length > kMaxStringLength)
+    return false;
+
+  str->resize(length);
+  return length == 0 || fread(&(*str)[0], length, 1, file) == 1;
+}
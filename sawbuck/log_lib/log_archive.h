@@ -0,0 +1,134 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Log archive declarations.
+#ifndef SAWBUCK_LOG_LIB_LOG_ARCHIVE_H_
+#define SAWBUCK_LOG_LIB_LOG_ARCHIVE_H_
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "base/basictypes.h"
+#include "sawbuck/log_lib/log_consumer.h"
+
+// The extension of log archive files.
+extern const wchar_t kLogArchiveExtension[];
+
+// Writes the log and trace messages it sinks to a log archive, a compact
+// binary file that sawbuck imports like the log files the messages come
+// from. Unlike these, an archive only holds the messages, without the
+// buffers they were logged in. Runs of identical log messages are collapsed
+// into a single message and a repeat count.
+class LogArchiveWriter : public LogEvents, public TraceEvents {
+ public:
+  // @param file the file to write to, which must outlive the writer.
+  explicit LogArchiveWriter(FILE* file);
+  ~LogArchiveWriter();
+
+  // Writes the archive header. This must be called before sinking messages.
+  // @returns true on success, false on a write error.
+  bool Init();
+
+  // Writes the pending run of log messages. This must be called once done
+  // sinking messages.
+  // @returns true if the archive was written without errors.
+  bool Flush();
+
+  // Returns the number of log messages collapsed into their predecessor.
+  size_t collapsed_messages() const { return collapsed_messages_; }
+
+  // LogEvents implementation.
+  virtual void OnLogMessage(const LogMessage& log_message);
+
+  // TraceEvents implementation.
+  virtual void OnTraceEventBegin(const TraceMessage& trace_message);
+  virtual void OnTraceEventEnd(const TraceMessage& trace_message);
+  virtual void OnTraceEventInstant(const TraceMessage& trace_message);
+
+ private:
+  // A copy of a log message, along with its repeat count.
+  struct PendingMessage {
+    PendingMessage() : level(0), process_id(0), thread_id(0), line(0),
+        repeat_count(0) {
+    }
+
+    base::Time time;
+    UCHAR level;
+    DWORD process_id;
+    DWORD thread_id;
+    std::vector<void*> traces;
+    std::string file;
+    int line;
+    std::string message;
+    uint32 repeat_count;
+  };
+
+  // Returns true if @p log_message repeats the pending message.
+  bool IsRepeat(const LogMessage& log_message) const;
+
+  // Writes the pending run of log messages, if any.
+  void WritePendingMessage();
+  void WriteTraceMessage(uint8 type, const TraceMessage& trace_message);
+  void WriteRecordHeader(uint8 type,
+                         base::Time time,
+                         uint8 level,
+                         uint32 process_id,
+                         uint32 thread_id,
+                         uint32 trace_depth,
+                         void* const* traces);
+  void WriteString(const char* str, size_t len);
+  void Write(const void* data, size_t size);
+
+  FILE* file_;
+  bool failed_;
+
+  // The last log message, which is written once a different one comes in.
+  PendingMessage pending_;
+  size_t collapsed_messages_;
+
+  DISALLOW_COPY_AND_ASSIGN(LogArchiveWriter);
+};
+
+// Reads a log archive, issuing its messages to the sinks. A collapsed run of
+// log messages is issued as its first message, with the repeat count
+// appended.
+class LogArchiveReader {
+ public:
+  LogArchiveReader();
+
+  void set_event_sink(LogEvents* log_event_sink) {
+    log_event_sink_ = log_event_sink;
+  }
+  void set_trace_sink(TraceEvents* trace_event_sink) {
+    trace_event_sink_ = trace_event_sink;
+  }
+
+  // Reads the archive in @p file, to the end.
+  // @returns true on success, false if the archive is invalid.
+  bool Read(FILE* file);
+
+ private:
+  bool ReadMessageBase(FILE* file, LogMessageBase* message);
+  bool ReadString(FILE* file, std::string* str);
+
+  // The stack trace of the message being read.
+  std::vector<void*> traces_;
+
+  LogEvents* log_event_sink_;
+  TraceEvents* trace_event_sink_;
+
+  DISALLOW_COPY_AND_ASSIGN(LogArchiveReader);
+};
+
+#endif  // SAWBUCK_LOG_LIB_LOG_ARCHIVE_H_
@@ -0,0 +1,205 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Log archive unittests.
+#include "sawbuck/log_lib/log_archive.h"
+
+#include "base/file_util.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/stringprintf.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+// Records the messages it sinks as strings.
+class TestSink : public LogEvents, public TraceEvents {
+ public:
+  virtual void OnLogMessage(const LogMessage& log_message) {
+    std::string record = base::StringPrintf("log %d %d %d %d %d ",
+        static_cast<int>(log_message.time.ToInternalValue()),
+        log_message.level, log_message.process_id, log_message.thread_id,
+        log_message.line);
+    for (size_t i = 0; i < log_message.trace_depth; ++i)
+      base::StringAppendF(&record, "%p ", log_message.traces[i]);
+    record.append(log_message.file, log_message.file_len).append(" ");
+    record.append(log_message.message, log_message.message_len);
+    records_.push_back(record);
+  }
+
+  virtual void OnTraceEventBegin(const TraceMessage& trace_message) {
+    AddTrace("begin", trace_message);
+  }
+  virtual void OnTraceEventEnd(const TraceMessage& trace_message) {
+    AddTrace("end", trace_message);
+  }
+  virtual void OnTraceEventInstant(const TraceMessage& trace_message) {
+    AddTrace("instant", trace_message);
+  }
+
+  const std::vector<std::string>& records() const { return records_; }
+
+ private:
+  void AddTrace(const char* type, const TraceMessage& trace_message) {
+    std::string record = base::StringPrintf("%s %d %p ", type,
+        trace_message.process_id, trace_message.id);
+    record.append(trace_message.name, trace_message.name_len).append(" ");
+    record.append(trace_message.extra, trace_message.extra_len);
+    records_.push_back(record);
+  }
+
+  std::vector<std::string> records_;
+};
+
+class LogArchiveTest : public testing::Test {
+ public:
+  virtual void SetUp() {
+    file_ = file_util::CreateAndOpenTemporaryFile(&path_);
+    ASSERT_TRUE(file_ != NULL);
+  }
+
+  virtual void TearDown() {
+    if (file_ != NULL)
+      file_util::CloseFile(file_);
+    file_util::Delete(path_, false);
+  }
+
+  void LogMessage(int time, DWORD thread_id, const char* message) {
+    LogEvents::LogMessage log_message;
+    log_message.time = base::Time::FromInternalValue(time);
+    log_message.level = TRACE_LEVEL_INFORMATION;
+    log_message.process_id = 1;
+    log_message.thread_id = thread_id;
+    log_message.trace_depth = arraysize(kTraces);
+    log_message.traces = kTraces;
+    log_message.file = "file.cc";
+    log_message.file_len = strlen(log_message.file);
+    log_message.line = 10;
+    log_message.message = message;
+    log_message.message_len = strlen(message);
+    writer_->OnLogMessage(log_message);
+  }
+
+  // Reads the archive back into sink_.
+  bool ReadArchive() {
+    rewind(file_);
+    LogArchiveReader reader;
+    reader.set_event_sink(&sink_);
+    reader.set_trace_sink(&sink_);
+    return reader.Read(file_);
+  }
+
+ protected:
+  static void* const kTraces[2];
+
+  FilePath path_;
+  FILE* file_;
+  scoped_ptr<LogArchiveWriter> writer_;
+  TestSink sink_;
+};
+
+void* const LogArchiveTest::kTraces[2] = {
+  reinterpret_cast<void*>(0x1000), reinterpret_cast<void*>(0x2000) };
+
+TEST_F(LogArchiveTest, RoundTrip) {
+  writer_.reset(new LogArchiveWriter(file_));
+  ASSERT_TRUE(writer_->Init());
+
+  LogMessage(1, 2, "first");
+  TraceEvents::TraceMessage trace_message;
+  trace_message.process_id = 3;
+  trace_message.id = reinterpret_cast<void*>(0x42);
+  trace_message.name = "name";
+  trace_message.name_len = 4;
+  trace_message.extra = "extra";
+  trace_message.extra_len = 5;
+  writer_->OnTraceEventBegin(trace_message);
+  writer_->OnTraceEventEnd(trace_message);
+  LogMessage(4, 5, "second");
+  ASSERT_TRUE(writer_->Flush());
+  EXPECT_EQ(0U, writer_->collapsed_messages());
+
+  ASSERT_TRUE(ReadArchive());
+  ASSERT_EQ(4U, sink_.records().size());
+  EXPECT_EQ(base::StringPrintf("log 1 %d 1 2 10 %p %p file.cc first",
+                               TRACE_LEVEL_INFORMATION, kTraces[0],
+                               kTraces[1]),
+            sink_.records()[0]);
+  EXPECT_EQ(base::StringPrintf("begin 3 %p name extra", trace_message.id),
+            sink_.records()[1]);
+  EXPECT_EQ(base::StringPrintf("end 3 %p name extra", trace_message.id),
+            sink_.records()[2]);
+  EXPECT_EQ(base::StringPrintf("log 4 %d 1 5 10 %p %p file.cc second",
+                               TRACE_LEVEL_INFORMATION, kTraces[0],
+                               kTraces[1]),
+            sink_.records()[3]);
+}
+
+TEST_F(LogArchiveTest, CollapsesRepeats) {
+  writer_.reset(new LogArchiveWriter(file_));
+  ASSERT_TRUE(writer_->Init());
+
+  LogMessage(1, 2, "spam");
+  LogMessage(2, 2, "spam");
+  LogMessage(3, 2, "spam");
+  // Same message on another thread.
+  LogMessage(4, 3, "spam");
+  LogMessage(5, 3, "other");
+  LogMessage(6, 3, "spam");
+  ASSERT_TRUE(writer_->Flush());
+  EXPECT_EQ(2U, writer_->collapsed_messages());
+
+  ASSERT_TRUE(ReadArchive());
+  ASSERT_EQ(4U, sink_.records().size());
+  // The collapsed run has the time of its first message.
+  EXPECT_EQ(base::StringPrintf(
+                "log 1 %d 1 2 10 %p %p file.cc spam (repeated 3 times)",
+                TRACE_LEVEL_INFORMATION, kTraces[0], kTraces[1]),
+            sink_.records()[0]);
+  EXPECT_EQ(base::StringPrintf("log 4 %d 1 3 10 %p %p file.cc spam",
+                               TRACE_LEVEL_INFORMATION, kTraces[0],
+                               kTraces[1]),
+            sink_.records()[1]);
+}
+
+TEST_F(LogArchiveTest, RejectsInvalidArchives) {
+  // Not an archive.
+  const char kGarbage[] = "This is not a log archive.";
+  ASSERT_EQ(1U, fwrite(kGarbage, sizeof(kGarbage), 1, file_));
+  EXPECT_FALSE(ReadArchive());
+  EXPECT_TRUE(sink_.records().empty());
+}
+
+TEST_F(LogArchiveTest, RejectsTruncatedArchives) {
+  writer_.reset(new LogArchiveWriter(file_));
+  ASSERT_TRUE(writer_->Init());
+  LogMessage(1, 2, "first");
+  LogMessage(2, 2, "second");
+  ASSERT_TRUE(writer_->Flush());
+
+  // Chop off the end of the last record.
+  file_util::CloseFile(file_);
+  file_ = NULL;
+  std::string contents;
+  ASSERT_TRUE(file_util::ReadFileToString(path_, &contents));
+  contents.resize(contents.size() - 1);
+  ASSERT_EQ(static_cast<int>(contents.size()),
+            file_util::WriteFile(path_, contents.data(), contents.size()));
+  file_ = file_util::OpenFile(path_, "rb");
+  ASSERT_TRUE(file_ != NULL);
+
+  EXPECT_FALSE(ReadArchive());
+  ASSERT_EQ(1U, sink_.records().size());
+}
+
+}  // namespace
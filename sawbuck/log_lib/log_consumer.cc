@@ -174,22 +174,92 @@ bool LogParser::ParseTraceEvent(EVENT_TRACE* event) {
   return false;
 }
 
+namespace {
+
+// The number of events that wake up the decoding thread.
+const size_t kDecodingBatchSize = 256;
+
+// How often the decoding thread polls for smaller batches.
+const int kDecodingIntervalMs = 20;
+
+}  // namespace
+
 LogConsumer* LogConsumer::current_ = NULL;
 
-LogConsumer::LogConsumer() {
+LogConsumer::LogConsumer()
+    : ring_(kRingCapacity),
+      events_pending_(false, false),
+      stop_decoding_(0),
+      dropped_events_(0) {
   DCHECK(current_ == NULL);
 
   current_ = this;
 }
 
 LogConsumer::~LogConsumer() {
+  if (decoding_thread_.get() != NULL)
+    StopDecoding();
+
   DCHECK(current_ == this);
   current_ = NULL;
 }
 
+void LogConsumer::StartDecoding() {
+  DCHECK(decoding_thread_.get() == NULL);
+
+  base::subtle::Release_Store(&stop_decoding_, 0);
+  decoding_thread_.reset(
+      new base::DelegateSimpleThread(this, "Event log decoder"));
+  decoding_thread_->Start();
+}
+
+void LogConsumer::StopDecoding() {
+  DCHECK(decoding_thread_.get() != NULL);
+
+  base::subtle::Release_Store(&stop_decoding_, 1);
+  events_pending_.Signal();
+  decoding_thread_->Join();
+  decoding_thread_.reset();
+
+  if (dropped_events_ != 0)
+    LOG(WARNING) << "Dropped " << dropped_events_ << " events.";
+}
+
 void LogConsumer::ProcessEvent(PEVENT_TRACE event) {
   DCHECK(current_ != NULL);
-  current_->ProcessOneEvent(event);
+
+  if (current_->decoding_thread_.get() == NULL) {
+    current_->ProcessOneEvent(event);
+    return;
+  }
+
+  // Only copy the event here, the decoding thread does the rest.
+  if (!current_->ring_.Push(event)) {
+    ++current_->dropped_events_;
+    return;
+  }
+
+  if (current_->ring_.size() == kDecodingBatchSize)
+    current_->events_pending_.Signal();
+}
+
+void LogConsumer::Run() {
+  while (base::subtle::Acquire_Load(&stop_decoding_) == 0) {
+    events_pending_.TimedWait(
+        base::TimeDelta::FromMilliseconds(kDecodingIntervalMs));
+    DecodeEvents();
+  }
+
+  // Catch up with the last events.
+  DecodeEvents();
+}
+
+void LogConsumer::DecodeEvents() {
+  EVENT_TRACE* event = ring_.Front();
+  for (; event != NULL; event = ring_.Front()) {
+    ProcessOneEvent(event);
+    ring_.Pop();
+  }
 }
 
 DWORD WINAPI LogConsumer::ThreadProc(LPVOID param) {
@@ -16,8 +16,13 @@
 #ifndef SAWBUCK_LOG_LIB_LOG_CONSUMER_H_
 #define SAWBUCK_LOG_LIB_LOG_CONSUMER_H_
 
+#include "base/atomicops.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/simple_thread.h"
 #include "base/time.h"
 #include "base/win/event_trace_consumer.h"
+#include "sawbuck/log_lib/event_ring.h"
 
 struct LogMessageBase {
   LogMessageBase() : level(0), process_id(0), thread_id(0), trace_depth(0),
@@ -105,15 +110,57 @@ class LogParser {
 
 class LogConsumer
     : public base::win::EtwTraceConsumerBase<LogConsumer>,
-      public LogParser {
+      public LogParser,
+      public base::DelegateSimpleThread::Delegate {
  public:
   LogConsumer();
   ~LogConsumer();
 
+  // Hands the events off to a dedicated decoding thread, so that the thread
+  // consuming the session returns them to ETW as fast as possible. Without
+  // this, events are decoded, and passed to the sinks, on the consuming
+  // thread.
+  void StartDecoding();
+
+  // Decodes the events handed off so far, then stops the decoding thread.
+  // This must be called once the consuming thread is done.
+  void StopDecoding();
+
+  // Returns the number of events dropped because the decoding thread was
+  // too far behind.
+  size_t dropped_events() const { return dropped_events_; }
+
   static DWORD WINAPI ThreadProc(LPVOID param);
   static void ProcessEvent(EVENT_TRACE* event);
+
+  // The number of events that can be handed off to the decoding thread
+  // before it catches up.
+  static const size_t kRingCapacity = 16 * 1024;
+
  private:
+  // DelegateSimpleThread::Delegate implementation, decodes events in
+  // batches until StopDecoding is called.
+  virtual void Run();
+
+  // Decodes the events handed off so far.
+  void DecodeEvents();
+
   static LogConsumer* current_;
+
+  // Hands the events off from the consuming thread to the decoding thread.
+  EventRing ring_;
+
+  // Signaled when a batch of events is ready for the decoding thread, which
+  // otherwise polls the ring.
+  base::WaitableEvent events_pending_;
+
+  // Set to non-zero to stop the decoding thread.
+  volatile base::subtle::Atomic32 stop_decoding_;
+
+  scoped_ptr<base::DelegateSimpleThread> decoding_thread_;
+
+  // Written by the consuming thread only.
+  size_t dropped_events_;
 };
 
 #endif  // SAWBUCK_LOG_LIB_LOG_CONSUMER_H_
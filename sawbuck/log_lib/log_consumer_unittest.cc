@@ -163,4 +163,22 @@ TEST_F(LogParserTest, ParseLogEventWithStackTrace) {
   EXPECT_TRUE(parser_.ProcessOneEvent(&log_msg_));
 }
 
+TEST_F(LogParserTest, DecodeOnDecodingThread) {
+  const size_t kEventCount = 1000;
+  LogConsumer consumer;
+  consumer.set_event_sink(&events_);
+
+  typedef LogEvents::LogMessage Msg;
+  EXPECT_CALL(events_, OnLogMessage(
+      Field(&Msg::message, StrEq(kMsgText))))
+      .Times(kEventCount);
+
+  consumer.StartDecoding();
+  for (size_t i = 0; i < kEventCount; ++i)
+    LogConsumer::ProcessEvent(&log_msg_);
+  consumer.StopDecoding();
+
+  EXPECT_EQ(0U, consumer.dropped_events());
+}
+
 }  // namespace
@@ -27,8 +27,16 @@
       'target_name': 'log_lib',
       'type': 'static_library',
       'sources': [
+        'cpu_profile.cc',
+        'cpu_profile.h',
+        'event_ring.cc',
+        'event_ring.h',
         'kernel_log_consumer.cc',
         'kernel_log_consumer.h',
+        'kernel_timeline.cc',
+        'kernel_timeline.h',
+        'log_archive.cc',
+        'log_archive.h',
         'log_consumer.cc',
         'log_consumer.h',
         'process_info_service.cc',
@@ -66,7 +74,11 @@
       'target_name': 'log_lib_unittests',
       'type': 'executable',
       'sources': [
+        'cpu_profile_unittest.cc',
+        'event_ring_unittest.cc',
         'kernel_log_consumer_unittest.cc',
+        'kernel_timeline_unittest.cc',
+        'log_archive_unittest.cc',
         'log_consumer_unittest.cc',
         'log_lib_unittest_main.cc',
         'process_info_service_unittest.cc',
@@ -80,6 +92,22 @@
         '<(DEPTH)/testing/gtest.gyp:gtest',
       ],
     },
+    {
+      'target_name': 'log_lib_benchmark',
+      'type': 'executable',
+      'sources': [
+        'benchmark_main.cc',
+        # The viewer's log store only depends on base. It's built in rather
+        # than depending on the viewer, which depends on this file.
+        '../viewer/log_store.cc',
+        '../viewer/log_store.h',
+      ],
+      'dependencies': [
+        'log_lib',
+        'test_common',
+        '<(DEPTH)/base/base.gyp:base',
+      ],
+    },
     {
       'target_name': 'dump_logs',
       'type': 'executable',
@@ -15,6 +15,7 @@
 // Symbol information service implementation.
 #include "sawbuck/log_lib/process_info_service.h"
 
+#include <algorithm>
 #include "base/string_util.h"
 #include "base/utf_string_conversions.h"
 
@@ -29,38 +30,89 @@ bool IProcessInfoService::ProcessInfo::operator == (
          exit_code_ == other.exit_code_;
 }
 
-ProcessInfoService::ProcessInfoService() {
+namespace {
+
+typedef IProcessInfoService::ProcessInfo ProcessInfo;
+
+// Orders process lifetimes by their start time.
+struct StartedBefore {
+  bool operator()(const ProcessInfo& info, const base::Time& time) const {
+    return info.started_ < time;
+  }
+  bool operator()(const base::Time& time, const ProcessInfo& info) const {
+    return time < info.started_;
+  }
+  bool operator()(const ProcessInfo& info1, const ProcessInfo& info2) const {
+    return info1.started_ < info2.started_;
+  }
+};
+
+// Returns true iff the process of @p info was running at @p time, where a
+// null end time means it's still running.
+bool IsRunningAt(const ProcessInfo& info, const base::Time& time) {
+  return info.started_ <= time &&
+      (info.ended_ == base::Time() || time < info.ended_);
+}
+
+}  // namespace
+
+ProcessInfoService::ProcessInfoService() : last_found_(NULL) {
 }
 
 ProcessInfoService::~ProcessInfoService() {
 }
 
-ProcessInfoService::ProcessInfoMap::iterator ProcessInfoService::FindProcess(
+IProcessInfoService::ProcessInfo* ProcessInfoService::FindProcess(
     DWORD process_id, const base::Time& time) {
   lock_.AssertAcquired();
-  ProcessKey key = std::make_pair(process_id, time);
-  ProcessInfoMap::iterator it(process_info_.lower_bound(key));
-
-  // We have two success cases here - either an exact match on {PID, time}, or
-  // else time > process start time, but < process end time, in which case
-  // lower bound will have returned us the next largest {PID, time} key,
-  // and we need to back up one.
-  if (it == process_info_.end() || it->first != key) {
-    // Are we at the beginning of the list, can't back up in that case.
-    if (it == process_info_.begin())
-      return process_info_.end();
-
-    --it;
+  if (last_found_ != NULL && last_found_->process_id_ == process_id &&
+      IsRunningAt(*last_found_, time)) {
+    return last_found_;
   }
 
-  // Are we pointing to relevant process info now? Need a match on pid,
-  // and (start <= time < end) - where zero end time means infinity.
-  if (it->first.first == process_id && it->second.started_ <= time &&
-      (it->second.ended_ == base::Time() || time < it->second.ended_)) {
-    return it;
-  }
+  ProcessInfoMap::iterator processes(process_info_.find(process_id));
+  if (processes == process_info_.end())
+    return NULL;
+
+  // The only candidate is the last process with this ID to start at or
+  // before time, provided it hadn't ended by then.
+  ProcessList& list = processes->second;
+  ProcessList::iterator it(
+      std::upper_bound(list.begin(), list.end(), time, StartedBefore()));
+  if (it == list.begin())
+    return NULL;
+
+  --it;
+  if (!IsRunningAt(*it, time))
+    return NULL;
+
+  last_found_ = &*it;
+  return last_found_;
+}
+
+void ProcessInfoService::InsertProcess(
+    const IProcessInfoService::ProcessInfo& info) {
+  lock_.AssertAcquired();
+  ProcessList& list = process_info_[info.process_id_];
+  ProcessList::iterator it(std::lower_bound(
+      list.begin(), list.end(), info.started_, StartedBefore()));
+  if (it != list.end() && it->started_ == info.started_)
+    return;
+
+  // Processes mostly start in order, so this is mostly an append.
+  list.insert(it, info);
+  last_found_ = NULL;
+}
+
+void ProcessInfoService::RemoveProcess(
+    const IProcessInfoService::ProcessInfo* info) {
+  lock_.AssertAcquired();
+  DCHECK(info != NULL);
+  ProcessList& list = process_info_[info->process_id_];
+  DCHECK(!list.empty() && info >= &list.front() && info <= &list.back());
 
-  return process_info_.end();
+  list.erase(list.begin() + (info - &list.front()));
+  last_found_ = NULL;
 }
 
 bool ProcessInfoService::GetProcessInfo(DWORD process_id,
@@ -68,10 +120,10 @@ bool ProcessInfoService::GetProcessInfo(DWORD process_id,
   base::AutoLock lock(lock_);
 
   DCHECK(info != NULL);
-  ProcessInfoMap::iterator it(FindProcess(process_id, time));
+  IProcessInfoService::ProcessInfo* found = FindProcess(process_id, time);
 
-  if (it != process_info_.end()) {
-    *info = it->second;
+  if (found != NULL) {
+    *info = *found;
     return true;
   }
 
@@ -89,9 +141,9 @@ void ProcessInfoService::OnProcessStarted(const base::Time& time,
   base::AutoLock lock(lock_);
 
    // See whether we have a record of this pid/time already.
-  ProcessInfoMap::iterator it(
-      FindProcess(process_info.process_id, time));
-  if (it == process_info_.end()) {
+  IProcessInfoService::ProcessInfo* found =
+      FindProcess(process_info.process_id, time);
+  if (found == NULL) {
     // Repack the kernel event to our notion of a process info.
     IProcessInfoService::ProcessInfo to_insert = {
         time,  // started_
@@ -108,11 +160,10 @@ void ProcessInfoService::OnProcessStarted(const base::Time& time,
       to_insert.command_line_ = process_info.command_line;
     }
 
-    ProcessKey key(process_info.process_id, time);
-    process_info_.insert(std::make_pair(key, to_insert));
+    InsertProcess(to_insert);
   } else {
     // Make a copy of the process info.
-    IProcessInfoService::ProcessInfo copy = it->second;
+    IProcessInfoService::ProcessInfo copy = *found;
 
     // We should have had an end time in the previous callback.
     DCHECK(base::Time() == copy.started_);
@@ -124,11 +175,10 @@ void ProcessInfoService::OnProcessStarted(const base::Time& time,
     DCHECK_EQ(process_info.session_id, copy.session_id_);
 
     // Drop the old entry, fix up the start time and reinsert it.
-    process_info_.erase(it);
+    RemoveProcess(found);
 
     copy.started_ = time;
-    ProcessKey key(process_info.process_id, time);
-    process_info_.insert(std::make_pair(key, copy));
+    InsertProcess(copy);
   }
 }
 
@@ -138,9 +188,9 @@ void ProcessInfoService::OnProcessEnded(const base::Time& time,
   base::AutoLock lock(lock_);
 
   // See whether we have a record of this pid/time already.
-  ProcessInfoMap::iterator it(
-      FindProcess(process_info.process_id, time));
-  if (it == process_info_.end()) {
+  IProcessInfoService::ProcessInfo* found =
+      FindProcess(process_info.process_id, time);
+  if (found == NULL) {
     // Repack the kernel event to our notion of a process info.
     IProcessInfoService::ProcessInfo to_insert = {
         base::Time(),  // started_
@@ -157,17 +207,16 @@ void ProcessInfoService::OnProcessEnded(const base::Time& time,
       to_insert.command_line_ = process_info.command_line;
     }
 
-    ProcessKey key(process_info.process_id, base::Time());
-    process_info_.insert(std::make_pair(key, to_insert));
+    InsertProcess(to_insert);
   } else {
     // We should not have had an end time in the previous callback.
-    DCHECK(base::Time() == it->second.ended_);
+    DCHECK(base::Time() == found->ended_);
     // Verify that we're seeing the same process info.
-    DCHECK_EQ(process_info.process_id, it->second.process_id_);
-    DCHECK_EQ(process_info.parent_id, it->second.parent_process_id_);
-    DCHECK_EQ(process_info.session_id, it->second.session_id_);
+    DCHECK_EQ(process_info.process_id, found->process_id_);
+    DCHECK_EQ(process_info.parent_id, found->parent_process_id_);
+    DCHECK_EQ(process_info.session_id, found->session_id_);
 
-    it->second.ended_ = time;
-    it->second.exit_code_ = exit_status;
+    found->ended_ = time;
+    found->exit_code_ = exit_status;
   }
 }
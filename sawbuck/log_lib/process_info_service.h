@@ -16,7 +16,8 @@
 #ifndef SAWBUCK_LOG_LIB_PROCESS_INFO_SERVICE_H_
 #define SAWBUCK_LOG_LIB_PROCESS_INFO_SERVICE_H_
 
-#include <map>
+#include <vector>
+#include "base/hash_tables.h"
 #include "base/synchronization/lock.h"
 #include "sawbuck/log_lib/kernel_log_consumer.h"
 
@@ -66,14 +67,29 @@ class ProcessInfoService
       ULONG exit_status);
 
  private:
-  typedef std::pair<DWORD, base::Time> ProcessKey;
-  typedef std::map<ProcessKey, IProcessInfoService::ProcessInfo>
-      ProcessInfoMap;
-  ProcessInfoMap::iterator FindProcess(DWORD process_id,
+  // The lifetimes of the processes that had a given ID, by start time. The
+  // IDs get reused, so there may be many of them over a long trace.
+  typedef std::vector<IProcessInfoService::ProcessInfo> ProcessList;
+  typedef base::hash_map<DWORD, ProcessList> ProcessInfoMap;
+
+  // Finds the process that had @p process_id at @p time.
+  // @returns the process info, or NULL if there's none.
+  IProcessInfoService::ProcessInfo* FindProcess(DWORD process_id,
       const base::Time& time);
 
+  // Adds @p info to the lifetimes of its process ID, unless there's one
+  // starting at the same time already.
+  void InsertProcess(const IProcessInfoService::ProcessInfo& info);
+
+  // Removes the lifetime @p info of its process ID.
+  void RemoveProcess(const IProcessInfoService::ProcessInfo* info);
+
   base::Lock lock_;
   ProcessInfoMap process_info_;  // Under lock_.
+
+  // The result of the last successful lookup, which successive lookups for
+  // the rows of a same process are likely to hit again.
+  IProcessInfoService::ProcessInfo* last_found_;  // Under lock_.
 };
 
 #endif  // SAWBUCK_LOG_LIB_PROCESS_INFO_SERVICE_H_
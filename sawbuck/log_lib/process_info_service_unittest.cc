@@ -209,4 +209,35 @@ TEST_F(ProcessInfoServiceTest, EndStart) {
   EXPECT_FALSE(service_.GetProcessInfo(kPid, kT2, &info));
 }
 
+TEST_F(ProcessInfoServiceTest, ReusedProcessIds) {
+  // Processes come and go, two IDs being reused over and over, with gaps
+  // where no process has them.
+  const int kLifetimes = 1000;
+  const base::TimeDelta kSecond = base::TimeDelta::FromSeconds(1);
+  for (int i = 0; i < kLifetimes; ++i) {
+    base::Time start = kT1 + kSecond * (10 * i);
+    DWORD pid = kPid + i % 2;
+    StartProcess(start, pid, kParentPid, kSession, Sids::World(),
+        kImageName, kCommandLine);
+    EndProcess(start + kSecond * 5, pid, kParentPid, kSession,
+        Sids::World(), kImageName, kCommandLine, i);
+  }
+
+  IProcessInfoService::ProcessInfo info = {};
+  EXPECT_FALSE(service_.GetProcessInfo(kPid, kT0, &info));
+  for (int i = 0; i < kLifetimes; ++i) {
+    base::Time start = kT1 + kSecond * (10 * i);
+    DWORD pid = kPid + i % 2;
+
+    EXPECT_TRUE(service_.GetProcessInfo(pid, start, &info));
+    EXPECT_EQ(static_cast<DWORD>(i), info.exit_code_);
+    EXPECT_TRUE(start == info.started_);
+    EXPECT_TRUE(service_.GetProcessInfo(pid, start + kSecond * 4, &info));
+    EXPECT_EQ(static_cast<DWORD>(i), info.exit_code_);
+
+    EXPECT_FALSE(service_.GetProcessInfo(pid, start + kSecond * 5, &info));
+    EXPECT_FALSE(service_.GetProcessInfo(pid ^ 1, start, &info));
+  }
+}
+
 }  // namespace
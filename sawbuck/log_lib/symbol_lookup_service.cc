@@ -20,15 +20,21 @@
 #include "base/bind.h"
 #include "base/message_loop.h"
 
-SymbolLookupService::SymbolLookupService() : background_thread_(NULL),
+SymbolLookupService::SymbolLookupService() : kernel_timeline_(NULL),
+    background_thread_(NULL),
     foreground_thread_(base::MessageLoop::current()), next_request_id_(0),
-    unprocessed_id_(0) {
+    unprocessed_id_(0), cached_modules_(0) {
 }
 
 SymbolLookupService::~SymbolLookupService() {
   // Make sure there aren't any tasks pending for this object.
   DCHECK(resolve_task_.is_null());
   DCHECK(callback_task_.is_null());
+
+  // The background thread is done with the symbols, save them for the next
+  // session.
+  if (!symbol_cache_file_.empty() && module_symbols_.dirty())
+    module_symbols_.Save(symbol_cache_file_);
 }
 
 SymbolLookupService::Handle SymbolLookupService::ResolveAddress(
@@ -74,127 +80,93 @@ void SymbolLookupService::SetSymbolPath(const wchar_t* symbol_path) {
                  symbol_path));
 }
 
-void SymbolLookupService::OnModuleIsLoaded(
-    DWORD process_id, const base::Time& time,
-    const ModuleInformation& module_info) {
-  // This is a notification of a module that was loaded at the time
-  // logging was started. Instead of recording the event's issue time as
-  // the load time, we instead pretend the module was loaded from the
-  // beginning of time, which it might as well have been from our
-  // perspective.
-  // Note: on a system running the usual complement of processes and
-  // services, the OnModuleIsLoaded notification events have been
-  // observed to lag the starting time of the trace by minutes.
-  return OnModuleLoad(process_id, base::Time(), module_info);
+void SymbolLookupService::SetSymbolCacheFile(const FilePath& path) {
+  background_thread_->PostTask(FROM_HERE,
+      base::Bind(&SymbolLookupService::SetSymbolCacheFileCallback,
+                 base::Unretained(this),
+                 path));
 }
 
-void SymbolLookupService::OnModuleUnload(
-    DWORD process_id, const base::Time& time,
-    const ModuleInformation& module_info) {
-  base::AutoLock lock(module_lock_);
-  module_cache_.ModuleUnloaded(process_id, time, module_info);
-}
+sym_util::SymbolCache* SymbolLookupService::GetSymbolCache(
+    ModuleLoadStateId id, sym_util::ProcessId pid, const base::Time& time) {
+  DCHECK_EQ(background_thread_, base::MessageLoop::current());
+  using sym_util::ModuleInformation;
+  using sym_util::SymbolCache;
 
-void SymbolLookupService::OnModuleLoad(
-    DWORD process_id, const base::Time& time,
-    const ModuleInformation& module_info) {
-  std::wstring file_path(module_info.image_file_name);
-  // Map device paths to drive paths.
-  DWORD drives = ::GetLogicalDrives();
-  char drive = 'A';
-  for (; drives != 0; drives >>= 1, ++drive) {
-    if (drives & 1) {
-      wchar_t device_path[1024] = {};
-      wchar_t device[] = { drive, L':', L'\0' };
-      if (::QueryDosDevice(device, device_path, arraysize(device_path)) &&
-          file_path.find(device_path) == 0) {
-        std::wstring new_path = device;
-        new_path += file_path.substr(wcslen(device_path));
-        file_path = new_path;
-      }
-    }
+  SymbolCacheMap::iterator it = symbol_caches_.find(id);
+  if (it != symbol_caches_.end()) {
+    // We have a hit, move our ID to the back of the LRU.
+    lru_module_id_.erase(
+        std::find(lru_module_id_.begin(), lru_module_id_.end(), id));
+    lru_module_id_.push_back(id);
+    return &it->second;
+  }
+
+  DCHECK(kernel_timeline_ != NULL);
+  std::vector<ModuleInformation> modules;
+  kernel_timeline_->GetProcessModuleState(pid, time, &modules);
+
+  // We have a miss, evict the least recently used instances until the new
+  // one fits in our budget.
+  while (!lru_module_id_.empty() &&
+         cached_modules_ + modules.size() > kMaxCachedModules) {
+    SymbolCacheMap::iterator to_evict =
+        symbol_caches_.find(lru_module_id_.front());
+    DCHECK(to_evict != symbol_caches_.end());
+    lru_module_id_.erase(lru_module_id_.begin());
+    cached_modules_ -= to_evict->second.num_modules();
+    symbol_caches_.erase(to_evict);
   }
 
-  ModuleInformation& info = const_cast<ModuleInformation&>(module_info);
-  info.image_file_name = file_path;
+  std::pair<SymbolCacheMap::iterator, bool> inserted =
+      symbol_caches_.insert(std::make_pair(id, SymbolCache()));
+  DCHECK_EQ(inserted.second, true);
+  lru_module_id_.push_back(id);
 
-  base::AutoLock lock(module_lock_);
+  SymbolCache& cache = inserted.first->second;
+  cache.set_status_callback(status_callback_);
+  cache.SetSymbolPath(symbol_path_.c_str());
+  cache.Initialize(modules.size(), modules.size() ? &modules[0] : NULL);
+  cached_modules_ += cache.num_modules();
 
-  module_cache_.ModuleLoaded(process_id, time, module_info);
+  return &cache;
 }
 
-bool SymbolLookupService::ResolveAddressImpl(sym_util::ProcessId pid,
+bool SymbolLookupService::ResolveAddressImpl(ModuleLoadStateId id,
+                                             sym_util::ProcessId pid,
                                              const base::Time& time,
                                              sym_util::Address address,
                                              sym_util::Symbol* symbol) {
   DCHECK_EQ(background_thread_, base::MessageLoop::current());
-  using sym_util::ModuleCache;
-  using sym_util::SymbolCache;
-
-  ModuleCache::ModuleLoadStateId id;
-  SymbolCacheMap::iterator it;
-
-  {
-    // Hold the module lock only while accessing the module cache.
-    base::AutoLock lock(module_lock_);
-
-    id = module_cache_.GetStateId(pid, time);
-    it = symbol_caches_.find(id);
-    if (it == symbol_caches_.end()) {
-      // We have a miss, initialize a cache for this module id.
-      if (symbol_caches_.size() == kMaxCacheSize) {
-        // Evict the least recently used element.
-        ModuleCache::ModuleLoadStateId to_evict = lru_module_id_.front();
-        lru_module_id_.erase(lru_module_id_.begin());
-        symbol_caches_.erase(to_evict);
-      }
+  DCHECK(symbol != NULL);
 
-      std::pair<SymbolCacheMap::iterator, bool> inserted =
-          symbol_caches_.insert(std::make_pair(id, SymbolCache()));
+  sym_util::SymbolCache* cache = GetSymbolCache(id, pid, time);
+  DCHECK(cache != NULL);
 
-      DCHECK_EQ(inserted.second, true);
-      SymbolCache& cache = inserted.first->second;
-      cache.set_status_callback(status_callback_);
+  // Look for the symbol in the processes, and the previous sessions, that
+  // loaded the same module first.
+  sym_util::ModuleInformation module;
+  bool has_module = cache->GetModuleForAddress(address, &module);
+  if (has_module && module_symbols_.Find(module, address, symbol))
+    return true;
 
-      std::vector<ModuleInformation> modules;
-      module_cache_.GetProcessModuleState(pid, time, &modules);
-      cache.SetSymbolPath(symbol_path_.c_str());
-      cache.Initialize(modules.size(), modules.size() ? &modules[0] : NULL);
+  // This can take a long time, so it's important not to hold any lock
+  // over this operation.
+  if (!cache->GetSymbolForAddress(address, symbol))
+    return false;
 
-      it = inserted.first;
-    } else {
-      // We have a hit, manage the LRU by removing our ID.
-      // It will be pushed to the back of the LRU just below.
-      lru_module_id_.erase(
-          std::find(lru_module_id_.begin(), lru_module_id_.end(), id));
-    }
-  }
-
-  // Push our id to the back of the lru list.
-  lru_module_id_.push_back(id);
+  if (has_module)
+    module_symbols_.Insert(module, address, *symbol);
 
-  DCHECK(it != symbol_caches_.end());
-  SymbolCache& cache = it->second;
-
-  // This can take a long time, so it's important not to
-  // hold the module lock over this operation.
-  bool ret = cache.GetSymbolForAddress(address, symbol);
-
-  // Clear the last status we posted.
-  if (!status_callback_.is_null())
-    status_callback_.Run(L"Ready\r\n");
-
-  return ret;
+  return true;
 }
 
 void SymbolLookupService::ResolveCallback() {
   DCHECK_EQ(background_thread_, base::MessageLoop::current());
 
   while (true) {
-    Handle request_id;
-    Request request;
-
-    // Find the next unresolved request.
+    // Grab all the unresolved requests.
+    std::vector<std::pair<Handle, Request> > batch;
     {
       base::AutoLock lock(resolution_lock_);
 
@@ -205,34 +177,63 @@ void SymbolLookupService::ResolveCallback() {
         return;
       }
 
-      request_id = it->first;
-      request = it->second;
+      for (; it != requests_.end(); ++it)
+        batch.push_back(*it);
+    }
+
+    // Identical addresses in processes with the same module load state
+    // resolve to the same symbol, so only resolve each such pair once.
+    // Ordering them by load state, then by address, resolves each state in
+    // a single symbol cache session, visiting its modules in turn.
+    typedef std::pair<ModuleLoadStateId, sym_util::Address> StateAddress;
+    typedef std::map<StateAddress, size_t> StateAddressMap;
+    StateAddressMap unique_requests;
+    std::vector<StateAddressMap::iterator> request_keys;
+    DCHECK(kernel_timeline_ != NULL);
+    for (size_t i = 0; i < batch.size(); ++i) {
+      const Request& request = batch[i].second;
+      StateAddress key(
+          kernel_timeline_->GetModuleLoadStateId(request.process_id_,
+                                                 request.time_),
+          request.address_);
+      request_keys.push_back(
+          unique_requests.insert(std::make_pair(key, i)).first);
     }
 
     // Don't hold the lock over the symbol resolution proper.
-    sym_util::Symbol symbol;
-    ResolveAddressImpl(request.process_id_,
-                       request.time_,
-                       request.address_,
-                       &symbol);
+    std::vector<sym_util::Symbol> symbols(batch.size());
+    StateAddressMap::const_iterator unique_it = unique_requests.begin();
+    for (; unique_it != unique_requests.end(); ++unique_it) {
+      const Request& request = batch[unique_it->second].second;
+      ResolveAddressImpl(unique_it->first.first,
+                         request.process_id_,
+                         request.time_,
+                         request.address_,
+                         &symbols[unique_it->second]);
+    }
 
-    // Store the result, mindfully of the fact that the request
+    // Clear the last status we posted.
+    if (!status_callback_.is_null())
+      status_callback_.Run(L"Ready\r\n");
+
+    // Store the results, mindfully of the fact that the requests
     // might have been cancelled while we did the resolution.
     {
       base::AutoLock lock(resolution_lock_);
 
-      RequestMap::iterator it = requests_.find(request_id);
-      if (it != requests_.end()) {
-        it->second.resolved_ = symbol;
+      for (size_t i = 0; i < batch.size(); ++i) {
+        RequestMap::iterator it = requests_.find(batch[i].first);
+        if (it != requests_.end())
+          it->second.resolved_ = symbols[request_keys[i]->second];
+      }
 
-        if (callback_task_.is_null()) {
-          callback_task_ = base::Bind(&SymbolLookupService::IssueCallbacks,
-                                      base::Unretained(this));
-          foreground_thread_->PostTask(FROM_HERE, callback_task_);
-        }
+      if (callback_task_.is_null()) {
+        callback_task_ = base::Bind(&SymbolLookupService::IssueCallbacks,
+                                    base::Unretained(this));
+        foreground_thread_->PostTask(FROM_HERE, callback_task_);
       }
 
-      unprocessed_id_ = request_id + 1;
+      unprocessed_id_ = batch.back().first + 1;
     }
   }
 }
@@ -246,6 +247,14 @@ void SymbolLookupService::SetSymbolPathCallback(const std::wstring& path) {
     it->second.SetSymbolPath(symbol_path_.c_str());
 }
 
+void SymbolLookupService::SetSymbolCacheFileCallback(const FilePath& path) {
+  DCHECK_EQ(background_thread_, base::MessageLoop::current());
+
+  symbol_cache_file_ = path;
+  if (!module_symbols_.Load(path))
+    LOG(INFO) << "No symbol cache loaded from " << path.value();
+}
+
 void SymbolLookupService::IssueCallbacks() {
   while (true) {
     Request request;
@@ -16,13 +16,15 @@
 #ifndef SAWBUCK_LOG_LIB_SYMBOL_LOOKUP_SERVICE_H_
 #define SAWBUCK_LOG_LIB_SYMBOL_LOOKUP_SERVICE_H_
 
+#include <map>
 #include <string>
 #include <vector>
 #include "base/callback.h"
+#include "base/file_path.h"
 #include "base/synchronization/lock.h"
 #include "base/time.h"
-#include "sawbuck/log_lib/kernel_log_consumer.h"
-#include "sawbuck/sym_util/module_cache.h"
+#include "sawbuck/log_lib/kernel_timeline.h"
+#include "sawbuck/sym_util/persistent_symbol_cache.h"
 #include "sawbuck/sym_util/symbol_cache.h"
 
 class ISymbolLookupService {
@@ -64,12 +66,9 @@ class ISymbolLookupService {
 // Fwd.
 namespace base { class MessageLoop; }
 
-// The symbol lookup service class knows how to sink the NT kernel log's
-// module events, and to subsequently service {pid,time,address}->symbol
-// queries on the processes it's heard of.
-class SymbolLookupService
-    : public ISymbolLookupService,
-      public KernelModuleEvents {
+// The symbol lookup service class services {pid,time,address}->symbol
+// queries on the processes of a kernel timeline.
+class SymbolLookupService : public ISymbolLookupService {
  public:
   SymbolLookupService();
   ~SymbolLookupService();
@@ -86,6 +85,17 @@ class SymbolLookupService
     background_thread_ = background_thread;
   }
 
+  // Accessors for the timeline of the modules loaded by the processes.
+  // Note: The timeline must outlive this object.
+  KernelTimeline* kernel_timeline() const { return kernel_timeline_; }
+  void set_kernel_timeline(KernelTimeline* kernel_timeline) {
+    kernel_timeline_ = kernel_timeline;
+  }
+
+  // Loads the symbols resolved in previous sessions from @p path, where the
+  // symbols resolved in this session are saved on destruction.
+  void SetSymbolCacheFile(const FilePath& path);
+
   // ISymboLookupService implementation.
   virtual Handle ResolveAddress(sym_util::ProcessId process_id,
                                 const base::Time& time,
@@ -94,41 +104,48 @@ class SymbolLookupService
   virtual void CancelRequest(Handle request_handle);
   virtual void SetSymbolPath(const wchar_t* symbol_path);
 
-  // KernelModuleEvents implementation.
-  virtual void OnModuleIsLoaded(DWORD process_id,
-                                const base::Time& time,
-                                const ModuleInformation& module_info);
-  virtual void OnModuleUnload(DWORD process_id,
-                              const base::Time& time,
-                              const ModuleInformation& module_info);
-  virtual void OnModuleLoad(DWORD process_id,
-                            const base::Time& time,
-                            const ModuleInformation& module_info);
-
  private:
-  virtual bool ResolveAddressImpl(sym_util::ProcessId process_id,
+  typedef KernelTimeline::ModuleLoadStateId ModuleLoadStateId;
+
+  // Resolves @p address in the module load state @p id, which is that of
+  // @p process_id at @p time.
+  virtual bool ResolveAddressImpl(ModuleLoadStateId id,
+                                  sym_util::ProcessId process_id,
                                   const base::Time& time,
                                   sym_util::Address address,
                                   sym_util::Symbol* symbol);
 
+  // Retrieves the symbol cache for the module load state @p id, which is
+  // that of @p process_id at @p time, creating it as need be.
+  sym_util::SymbolCache* GetSymbolCache(ModuleLoadStateId id,
+                                        sym_util::ProcessId process_id,
+                                        const base::Time& time);
+
   void SetSymbolPathCallback(const std::wstring& path);
+  void SetSymbolCacheFileCallback(const FilePath& path);
   void ResolveCallback();
   void IssueCallbacks();
 
-  base::Lock module_lock_;
-  sym_util::ModuleCache module_cache_;  // Under module_lock_.
+  // The timeline we look up the modules of the processes in.
+  KernelTimeline* kernel_timeline_;
 
   // We keep a cache of symbol cache instances keyed on module
-  // load state id with an lru replacement policy.
-  typedef std::map<sym_util::ModuleCache::ModuleLoadStateId,
-      sym_util::SymbolCache> SymbolCacheMap;
-  static const size_t kMaxCacheSize = 10;
-  typedef std::vector<sym_util::ModuleCache::ModuleLoadStateId>
-      LoadStateVector;
+  // load state id with an lru replacement policy. Each instance holds a
+  // DbgHelp session with all the modules of its load state, so the cache
+  // is bounded by the total number of modules it holds.
+  typedef std::map<ModuleLoadStateId, sym_util::SymbolCache> SymbolCacheMap;
+  static const size_t kMaxCachedModules = 1024;
+  typedef std::vector<ModuleLoadStateId> LoadStateVector;
   LoadStateVector lru_module_id_;
   SymbolCacheMap symbol_caches_;
+  size_t cached_modules_;
   std::wstring symbol_path_;
 
+  // The symbols resolved so far, shared by the processes that load the same
+  // modules, and by the sessions that use the same symbol cache file.
+  sym_util::PersistentSymbolCache module_symbols_;
+  FilePath symbol_cache_file_;
+
   base::Lock resolution_lock_;
   struct Request {
     sym_util::ProcessId process_id_;
@@ -42,6 +42,7 @@ class SymbolLookupServiceTest: public testing::Test {
   virtual void SetUp() {
     ASSERT_TRUE(background_thread_.Start());
     service_.set_background_thread(background_thread_.message_loop());
+    service_.set_kernel_timeline(&timeline_);
   }
 
   virtual void TearDown() {
@@ -49,6 +50,11 @@ class SymbolLookupServiceTest: public testing::Test {
   }
 
   void LoadModules() {
+    LoadModules(::GetCurrentProcessId());
+  }
+
+  // Loads the modules of the current process into process @p pid.
+  void LoadModules(sym_util::ProcessId pid) {
     base::win::ScopedHandle snap(
         ::CreateToolhelp32Snapshot(TH32CS_SNAPMODULE, ::GetCurrentProcessId()));
     base::Time now(base::Time::Now());
@@ -70,7 +76,7 @@ class SymbolLookupServiceTest: public testing::Test {
           image.GetNTHeaders()->FileHeader.TimeDateStamp;
       module_info.image_file_name = module.szExePath;
 
-      service_.OnModuleLoad(::GetCurrentProcessId(), now, module_info);
+      timeline_.OnModuleLoad(pid, now, module_info);
 
     } while (::Module32Next(snap, &module));
   }
@@ -107,6 +113,7 @@ class SymbolLookupServiceTest: public testing::Test {
 
   MessageLoop message_loop_;
   base::Thread background_thread_;
+  KernelTimeline timeline_;
   SymbolLookupService service_;
 };
 
@@ -146,6 +153,29 @@ TEST_F(SymbolLookupServiceTest, LookupFoo) {
   ASSERT_EQ(10, resolved_.size());
 }
 
+TEST_F(SymbolLookupServiceTest, LookupFooInProcessesWithSameModules) {
+  // Two processes with the same modules share the same resolutions.
+  const sym_util::ProcessId kOtherProcessId = ::GetCurrentProcessId() + 1;
+  LoadModules();
+  LoadModules(kOtherProcessId);
+
+  for (int i = 0; i < 10; ++i) {
+    SymbolLookupService::Handle h =
+        service_.ResolveAddress(
+            i % 2 ? kOtherProcessId : ::GetCurrentProcessId(),
+            base::Time::Now(),
+            reinterpret_cast<sym_util::Address>(&Foo),
+            base::Bind(&SymbolLookupServiceTest::FooResolved,
+                       base::Unretained(this)));
+
+    ASSERT_NE(SymbolLookupService::kInvalidHandle, h);
+  }
+
+  ResolveAll();
+
+  ASSERT_EQ(10, resolved_.size());
+}
+
 TEST_F(SymbolLookupServiceTest, LookupFooCancel) {
   LoadModules();
 
@@ -17,11 +17,13 @@
     'chromium_code': 1,
     'etw_sources': [
       'etw/__init__.py',
+      'etw/_decoder.cc',
       'etw/consumer.py',
       'etw/controller.py',
       'etw/evntcons.py',
       'etw/evntrace.py',
       'etw/guiddef.py',
+      'etw/native.py',
       'etw/provider.py',
       'etw/util.py',
       'etw/descriptors/__init__.py',
@@ -52,7 +54,7 @@
             '<@(etw_sources)',
           ],
           'outputs': [
-            '<(PRODUCT_DIR)/ETW-0.6.5.0-py2.6.egg',
+            '<(PRODUCT_DIR)/ETW-0.6.5.0-py2.6-win32.egg',
           ],
           'action': [
             '"<(DEPTH)/third_party/setuptools/setup_env.bat" &&'
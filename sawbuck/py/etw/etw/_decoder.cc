@@ -0,0 +1,564 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Implements the etw._decoder extension module, which decodes the payloads
+// of ETW events natively. The events are described by format strings that
+// etw.native derives from the _fields_ of the EventClass descriptors, with
+// one character per field:
+//
+//   '?' Boolean    'b' Int8     'B' UInt8    'h' Int16    'H' UInt16
+//   'i' Int32      'I' UInt32   'q' Int64    'Q' UInt64   'P' Pointer
+//   's' String     'w' WString  'S' Sid      't' WmiTime
+//
+// The module exposes two functions:
+//
+// Decode(format, data, is_64_bit_log) decodes a single payload into a tuple.
+//
+// Consume(log_files, formats, callback) consumes the given log files, and
+// decodes the events described by the formats dictionary. This maps a key of
+// the caller's choosing to a (guid_bytes_le, version, type, format) tuple.
+// The decoded events are delivered a log buffer at a time, through a call to
+// callback(key, records) for each key that had events in the buffer. Each
+// record is a (process_id, thread_id, time_stamp, field1, field2, ...) tuple.
+// The callback may return False to stop the consumption. Consume returns a
+// (decoded_events, malformed_events) tuple.
+//
+// Unlike the pure Python decoding, times are returned in raw session units
+// and SIDs as their binary representation, so that the conversions can be
+// done a whole batch at a time.
+#include <Python.h>
+#include <windows.h>
+#include <evntcons.h>
+#include <evntrace.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Reads the fields of an event payload, checking for overflows.
+class PayloadReader {
+ public:
+  PayloadReader(const void* data, size_t length, bool is_64_bit_log)
+      : data_(reinterpret_cast<const char*>(data)),
+        length_(length),
+        offset_(0),
+        is_64_bit_log_(is_64_bit_log) {
+  }
+
+  // Decodes the fields described by @p format.
+  // @returns a new reference to a tuple of the field values, or NULL if the
+  //     payload is malformed or an allocation failed. In the former case no
+  //     Python error is set.
+  PyObject* Decode(const char* format, size_t format_length);
+
+  // Decodes the fields described by @p format, and stores them in @p tuple
+  // starting at index @p first.
+  // @returns true on success, false otherwise.
+  bool DecodeInto(const char* format,
+                  size_t format_length,
+                  PyObject* tuple,
+                  Py_ssize_t first);
+
+ private:
+  template <typename T>
+  bool Read(T* value) {
+    if (length_ - offset_ < sizeof(T))
+      return false;
+    ::memcpy(value, data_ + offset_, sizeof(T));
+    offset_ += sizeof(T);
+    return true;
+  }
+
+  bool ReadPointer(ULONGLONG* value);
+
+  // @returns a new reference to the value of the field of type @p code, or
+  //     NULL on failure.
+  PyObject* DecodeField(char code);
+
+  const char* data_;
+  size_t length_;
+  size_t offset_;
+  bool is_64_bit_log_;
+};
+
+bool PayloadReader::ReadPointer(ULONGLONG* value) {
+  if (is_64_bit_log_)
+    return Read(value);
+
+  ULONG value32 = 0;
+  if (!Read(&value32))
+    return false;
+  *value = value32;
+  return true;
+}
+
+PyObject* PayloadReader::DecodeField(char code) {
+  switch (code) {
+    case '?': {
+      char value = 0;
+      return Read(&value) ? PyBool_FromLong(value != 0) : NULL;
+    }
+    case 'b': {
+      signed char value = 0;
+      return Read(&value) ? PyInt_FromLong(value) : NULL;
+    }
+    case 'B': {
+      unsigned char value = 0;
+      return Read(&value) ? PyInt_FromLong(value) : NULL;
+    }
+    case 'h': {
+      short value = 0;
+      return Read(&value) ? PyInt_FromLong(value) : NULL;
+    }
+    case 'H': {
+      unsigned short value = 0;
+      return Read(&value) ? PyInt_FromLong(value) : NULL;
+    }
+    case 'i': {
+      int value = 0;
+      return Read(&value) ? PyInt_FromLong(value) : NULL;
+    }
+    case 'I': {
+      unsigned int value = 0;
+      return Read(&value) ? PyLong_FromUnsignedLong(value) : NULL;
+    }
+    case 'q': {
+      LONGLONG value = 0;
+      return Read(&value) ? PyLong_FromLongLong(value) : NULL;
+    }
+    case 'Q':
+    case 't': {
+      ULONGLONG value = 0;
+      return Read(&value) ? PyLong_FromUnsignedLongLong(value) : NULL;
+    }
+    case 'P': {
+      ULONGLONG value = 0;
+      return ReadPointer(&value) ? PyLong_FromUnsignedLongLong(value) : NULL;
+    }
+    case 's': {
+      const char* start = data_ + offset_;
+      size_t remaining = length_ - offset_;
+      const char* end = reinterpret_cast<const char*>(
+          ::memchr(start, 0, remaining));
+      if (end == NULL)
+        return NULL;
+      offset_ += end - start + 1;
+      return PyString_FromStringAndSize(start, end - start);
+    }
+    case 'w': {
+      const wchar_t* start =
+          reinterpret_cast<const wchar_t*>(data_ + offset_);
+      size_t remaining = (length_ - offset_) / sizeof(wchar_t);
+      size_t length = 0;
+      while (length < remaining && start[length] != L'\0')
+        ++length;
+      if (length == remaining)
+        return NULL;
+      offset_ += (length + 1) * sizeof(wchar_t);
+      return PyUnicode_FromWideChar(start, length);
+    }
+    case 'S': {
+      // Two pointers precede the SID. If the first one is zero, there is no
+      // SID.
+      ULONGLONG has_sid = 0;
+      ULONGLONG ignored = 0;
+      if (!ReadPointer(&has_sid))
+        return NULL;
+      if (has_sid == 0)
+        Py_RETURN_NONE;
+      if (!ReadPointer(&ignored))
+        return NULL;
+
+      // The fixed part of a SID precedes its variable-length sub-authorities.
+      const size_t kMinimumSidSize = 8;
+      PSID sid = const_cast<char*>(data_ + offset_);
+      if (length_ - offset_ < kMinimumSidSize || !::IsValidSid(sid))
+        return NULL;
+      size_t sid_length = ::GetLengthSid(sid);
+      if (length_ - offset_ < sid_length)
+        return NULL;
+      offset_ += sid_length;
+      return PyString_FromStringAndSize(reinterpret_cast<const char*>(sid),
+                                        sid_length);
+    }
+    default: {
+      PyErr_Format(PyExc_ValueError, "Invalid field code '%c'.", code);
+      return NULL;
+    }
+  }
+}
+
+bool PayloadReader::DecodeInto(const char* format,
+                               size_t format_length,
+                               PyObject* tuple,
+                               Py_ssize_t first) {
+  for (size_t i = 0; i < format_length; ++i) {
+    PyObject* value = DecodeField(format[i]);
+    if (value == NULL)
+      return false;
+    PyTuple_SET_ITEM(tuple, first + i, value);
+  }
+  return true;
+}
+
+PyObject* PayloadReader::Decode(const char* format, size_t format_length) {
+  PyObject* tuple = PyTuple_New(format_length);
+  if (tuple == NULL)
+    return NULL;
+  if (!DecodeInto(format, format_length, tuple, 0)) {
+    Py_DECREF(tuple);
+    return NULL;
+  }
+  return tuple;
+}
+
+// Identifies the events of a given format.
+struct EventKey {
+  bool operator<(const EventKey& other) const {
+    int compare = ::memcmp(&guid, &other.guid, sizeof(guid));
+    if (compare != 0)
+      return compare < 0;
+    if (version != other.version)
+      return version < other.version;
+    return type < other.type;
+  }
+
+  GUID guid;
+  UCHAR version;
+  UCHAR type;
+};
+
+// The decoding state of the events of a given format.
+struct EventFormat {
+  // The caller's key for these events. This is a borrowed reference, which
+  // the formats dictionary keeps alive.
+  PyObject* key;
+  std::string format;
+  // The records decoded since the last delivery, or NULL if there are none.
+  PyObject* records;
+};
+
+// Consumes a set of log files, and delivers their decoded events a buffer at
+// a time.
+class BatchConsumer {
+ public:
+  explicit BatchConsumer(PyObject* callback)
+      : callback_(callback),
+        stopped_(false),
+        failed_(false),
+        decoded_events_(0),
+        malformed_events_(0) {
+  }
+
+  ~BatchConsumer() {
+    FormatMap::iterator it = formats_.begin();
+    for (; it != formats_.end(); ++it)
+      Py_XDECREF(it->second.records);
+  }
+
+  // Adds the formats described by the formats dictionary.
+  // @returns true on success, false with a Python error set otherwise.
+  bool AddFormats(PyObject* formats);
+
+  // Consumes the given log files.
+  // @returns true on success, false with a Python error set otherwise.
+  bool Consume(const std::vector<std::wstring>& log_files);
+
+  size_t decoded_events() const { return decoded_events_; }
+  size_t malformed_events() const { return malformed_events_; }
+
+ private:
+  typedef std::map<EventKey, EventFormat> FormatMap;
+
+  static VOID WINAPI OnEventRecord(PEVENT_RECORD event_record);
+  static ULONG WINAPI OnBuffer(PEVENT_TRACE_LOGFILEW log_file);
+
+  // Decodes an event, if it has a known format.
+  void DecodeEvent(PEVENT_RECORD event_record);
+
+  // Delivers the records decoded since the last delivery.
+  void DeliverRecords();
+
+  PyObject* callback_;
+  FormatMap formats_;
+
+  // Set once the callback has asked to stop, or has failed.
+  bool stopped_;
+  // Set if a Python error occurred.
+  bool failed_;
+
+  size_t decoded_events_;
+  size_t malformed_events_;
+};
+
+bool BatchConsumer::AddFormats(PyObject* formats) {
+  if (!PyDict_Check(formats)) {
+    PyErr_SetString(PyExc_TypeError, "formats must be a dictionary.");
+    return false;
+  }
+
+  Py_ssize_t pos = 0;
+  PyObject* key = NULL;
+  PyObject* value = NULL;
+  while (PyDict_Next(formats, &pos, &key, &value)) {
+    const char* guid = NULL;
+    int guid_length = 0;
+    int version = 0;
+    int type = 0;
+    const char* format = NULL;
+    int format_length = 0;
+    if (!PyArg_ParseTuple(value, "s#iis#", &guid, &guid_length, &version,
+                          &type, &format, &format_length)) {
+      return false;
+    }
+    if (guid_length != sizeof(GUID)) {
+      PyErr_SetString(PyExc_ValueError, "Invalid GUID.");
+      return false;
+    }
+
+    EventKey event_key = {};
+    ::memcpy(&event_key.guid, guid, sizeof(GUID));
+    event_key.version = static_cast<UCHAR>(version);
+    event_key.type = static_cast<UCHAR>(type);
+
+    EventFormat& event_format = formats_[event_key];
+    event_format.key = key;
+    event_format.format.assign(format, format_length);
+    event_format.records = NULL;
+  }
+
+  return true;
+}
+
+bool BatchConsumer::Consume(const std::vector<std::wstring>& log_files) {
+  std::vector<TRACEHANDLE> handles;
+  for (size_t i = 0; i < log_files.size(); ++i) {
+    EVENT_TRACE_LOGFILEW log_file = {};
+    log_file.LogFileName = const_cast<wchar_t*>(log_files[i].c_str());
+    log_file.ProcessTraceMode = PROCESS_TRACE_MODE_EVENT_RECORD;
+    log_file.EventRecordCallback = &OnEventRecord;
+    log_file.BufferCallback = &OnBuffer;
+    log_file.Context = this;
+
+    TRACEHANDLE handle = ::OpenTraceW(&log_file);
+    if (handle == INVALID_PROCESSTRACE_HANDLE) {
+      PyErr_SetFromWindowsErrWithUnicodeFilename(::GetLastError(),
+                                                 log_files[i].c_str());
+      for (size_t j = 0; j < handles.size(); ++j)
+        ::CloseTrace(handles[j]);
+      return false;
+    }
+    handles.push_back(handle);
+  }
+
+  ULONG error = ERROR_SUCCESS;
+  if (!handles.empty())
+    error = ::ProcessTrace(&handles[0], handles.size(), NULL, NULL);
+  for (size_t i = 0; i < handles.size(); ++i)
+    ::CloseTrace(handles[i]);
+
+  // Deliver the events of the last buffer.
+  if (!stopped_)
+    DeliverRecords();
+
+  if (failed_)
+    return false;
+  if (error != ERROR_SUCCESS && error != ERROR_CANCELLED) {
+    PyErr_SetFromWindowsErr(error);
+    return false;
+  }
+
+  return true;
+}
+
+VOID WINAPI BatchConsumer::OnEventRecord(PEVENT_RECORD event_record) {
+  BatchConsumer* self =
+      reinterpret_cast<BatchConsumer*>(event_record->UserContext);
+  if (!self->stopped_)
+    self->DecodeEvent(event_record);
+}
+
+ULONG WINAPI BatchConsumer::OnBuffer(PEVENT_TRACE_LOGFILEW log_file) {
+  BatchConsumer* self = reinterpret_cast<BatchConsumer*>(log_file->Context);
+  if (!self->stopped_)
+    self->DeliverRecords();
+  return self->stopped_ ? FALSE : TRUE;
+}
+
+void BatchConsumer::DecodeEvent(PEVENT_RECORD event_record) {
+  const EVENT_HEADER& header = event_record->EventHeader;
+
+  // Classic events carry their type in the opcode.
+  EventKey event_key = {};
+  event_key.guid = header.ProviderId;
+  event_key.version = header.EventDescriptor.Version;
+  event_key.type = header.EventDescriptor.Opcode;
+  FormatMap::iterator it = formats_.find(event_key);
+  if (it == formats_.end())
+    return;
+  EventFormat& event_format = it->second;
+
+  bool is_64_bit_log = (header.Flags & EVENT_HEADER_FLAG_64_BIT_HEADER) != 0;
+  PayloadReader reader(event_record->UserData,
+                       event_record->UserDataLength,
+                       is_64_bit_log);
+
+  const Py_ssize_t kHeaderFields = 3;
+  PyObject* record =
+      PyTuple_New(kHeaderFields + event_format.format.length());
+  if (record == NULL) {
+    failed_ = stopped_ = true;
+    return;
+  }
+  PyTuple_SET_ITEM(record, 0, PyInt_FromLong(header.ProcessId));
+  PyTuple_SET_ITEM(record, 1, PyInt_FromLong(header.ThreadId));
+  PyTuple_SET_ITEM(record, 2,
+                   PyLong_FromLongLong(header.TimeStamp.QuadPart));
+
+  if (!reader.DecodeInto(event_format.format.data(),
+                         event_format.format.length(),
+                         record,
+                         kHeaderFields)) {
+    Py_DECREF(record);
+    if (PyErr_Occurred()) {
+      failed_ = stopped_ = true;
+    } else {
+      ++malformed_events_;
+    }
+    return;
+  }
+
+  if (event_format.records == NULL) {
+    event_format.records = PyList_New(0);
+    if (event_format.records == NULL) {
+      Py_DECREF(record);
+      failed_ = stopped_ = true;
+      return;
+    }
+  }
+  int result = PyList_Append(event_format.records, record);
+  Py_DECREF(record);
+  if (result != 0) {
+    failed_ = stopped_ = true;
+    return;
+  }
+
+  ++decoded_events_;
+}
+
+void BatchConsumer::DeliverRecords() {
+  FormatMap::iterator it = formats_.begin();
+  for (; it != formats_.end(); ++it) {
+    PyObject* records = it->second.records;
+    if (records == NULL)
+      continue;
+    it->second.records = NULL;
+
+    PyObject* result = PyObject_CallFunctionObjArgs(callback_,
+                                                    it->second.key,
+                                                    records,
+                                                    NULL);
+    Py_DECREF(records);
+    if (result == NULL) {
+      failed_ = stopped_ = true;
+      return;
+    }
+    if (result == Py_False)
+      stopped_ = true;
+    Py_DECREF(result);
+    if (stopped_)
+      return;
+  }
+}
+
+PyObject* Decode(PyObject* self, PyObject* args) {
+  const char* format = NULL;
+  int format_length = 0;
+  const char* data = NULL;
+  int data_length = 0;
+  PyObject* is_64_bit_log = NULL;
+  if (!PyArg_ParseTuple(args, "s#s#O:Decode", &format, &format_length,
+                        &data, &data_length, &is_64_bit_log)) {
+    return NULL;
+  }
+
+  PayloadReader reader(data, data_length,
+                       PyObject_IsTrue(is_64_bit_log) == 1);
+  PyObject* tuple = reader.Decode(format, format_length);
+  if (tuple == NULL && !PyErr_Occurred())
+    PyErr_SetString(PyExc_ValueError, "Malformed event data.");
+  return tuple;
+}
+
+PyObject* Consume(PyObject* self, PyObject* args) {
+  PyObject* log_files = NULL;
+  PyObject* formats = NULL;
+  PyObject* callback = NULL;
+  if (!PyArg_ParseTuple(args, "OOO:Consume", &log_files, &formats,
+                        &callback)) {
+    return NULL;
+  }
+  if (!PyCallable_Check(callback)) {
+    PyErr_SetString(PyExc_TypeError, "callback must be callable.");
+    return NULL;
+  }
+
+  PyObject* log_files_seq = PySequence_Fast(log_files,
+                                            "log_files must be a sequence.");
+  if (log_files_seq == NULL)
+    return NULL;
+  std::vector<std::wstring> log_file_paths;
+  for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(log_files_seq); ++i) {
+    PyObject* path = PyUnicode_FromObject(
+        PySequence_Fast_GET_ITEM(log_files_seq, i));
+    if (path == NULL) {
+      Py_DECREF(log_files_seq);
+      return NULL;
+    }
+    std::wstring path_str(PyUnicode_GET_SIZE(path), L'\0');
+    PyUnicode_AsWideChar(reinterpret_cast<PyUnicodeObject*>(path),
+                         &path_str[0],
+                         static_cast<Py_ssize_t>(path_str.size()));
+    log_file_paths.push_back(path_str);
+    Py_DECREF(path);
+  }
+  Py_DECREF(log_files_seq);
+
+  BatchConsumer consumer(callback);
+  if (!consumer.AddFormats(formats) || !consumer.Consume(log_file_paths))
+    return NULL;
+
+  return Py_BuildValue(
+      "(nn)",
+      static_cast<Py_ssize_t>(consumer.decoded_events()),
+      static_cast<Py_ssize_t>(consumer.malformed_events()));
+}
+
+PyMethodDef kMethods[] = {
+  { "Decode", Decode, METH_VARARGS,
+    "Decode(format, data, is_64_bit_log) -> tuple of field values." },
+  { "Consume", Consume, METH_VARARGS,
+    "Consume(log_files, formats, callback) -> "
+    "(decoded_events, malformed_events)." },
+  { NULL, NULL, 0, NULL }
+};
+
+}  // namespace
+
+PyMODINIT_FUNC init_decoder() {
+  Py_InitModule3("_decoder", kMethods,
+                 "Native decoding of ETW event payloads.");
+}
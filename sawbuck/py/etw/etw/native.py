@@ -0,0 +1,300 @@
+# Copyright 2013 Google Inc.
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""Implements a trace consumer utility class."""
+"""Implements a trace consumer that decodes events natively, in batches.
+
+The pure Python TraceEventSource decodes each event field by field, and
+dispatches it through a Python callback. This module instead decodes the
+events in the etw._decoder extension, using formats derived from the same
+EventClass descriptors, and dispatches them a log buffer at a time:
+
+class MyConsumer(BatchEventConsumer):
+  @BatchEventHandler(pagefault.Event.HardPageFault)
+  def OnHardPageFaults(self, batch):
+    faults = batch.ToArray()
+    ...
+
+source = BatchTraceEventSource([MyConsumer()])
+source.OpenFileSession('kernel.etl')
+source.Consume()
+
+The records of a batch are tuples of the process ID, thread ID and raw time
+stamp of each event, followed by its fields. Times, including WmiTime fields,
+are in raw session units, which are FILETIME units for file sessions. SIDs
+are returned as their binary representation.
+"""
+from collections import defaultdict
+from etw import util
+from etw.descriptors import event
+from etw.descriptors import field
+import logging
+import uuid
+
+from etw import _decoder
+
+
+# Maps the callable field types to the field codes of the native decoder.
+_FIELD_CODES = {
+  field.Boolean: '?',
+  field.Int8: 'b',
+  field.UInt8: 'B',
+  field.Int16: 'h',
+  field.UInt16: 'H',
+  field.Int32: 'i',
+  field.UInt32: 'I',
+  field.Int64: 'q',
+  field.UInt64: 'Q',
+  field.Pointer: 'P',
+  field.String: 's',
+  field.WString: 'w',
+  field.Sid: 'S',
+  field.WmiTime: 't',
+}
+
+
+# Maps the field codes of the native decoder to NumPy types.
+_NUMPY_TYPES = {
+  '?': 'bool',
+  'b': 'int8',
+  'B': 'uint8',
+  'h': 'int16',
+  'H': 'uint16',
+  'i': 'int32',
+  'I': 'uint32',
+  'q': 'int64',
+  'Q': 'uint64',
+  'P': 'uint64',
+  's': 'object',
+  'w': 'object',
+  'S': 'object',
+  't': 'uint64',
+}
+
+
+# The header fields that precede the event fields in each record.
+_HEADER_FIELDS = [('process_id', 'uint32'),
+                  ('thread_id', 'uint32'),
+                  ('raw_time_stamp', 'int64')]
+
+
+def _BindHandler(handler_func, handler_instance):
+  def BoundHandler(batch):
+    handler_func(handler_instance, batch)
+  return BoundHandler
+
+
+def GetEventFormat(event_class):
+  """Returns the native decoder format of an EventClass subclass.
+
+  Args:
+    event_class: the EventClass subclass to get the format of.
+
+  Returns:
+    A string with one field code per field of the event class.
+
+  Raises:
+    ValueError: a field of the event class has no native decoding.
+  """
+  codes = []
+  for name, field_type in event_class._fields_:
+    code = _FIELD_CODES.get(field_type, None)
+    if code is None:
+      raise ValueError('Field %s of %s has no native decoding.' %
+                       (name, event_class.__name__))
+    codes.append(code)
+  return ''.join(codes)
+
+
+def Decode(event_class, data, is_64_bit_log=False):
+  """Decodes a single event payload natively.
+
+  Args:
+    event_class: the EventClass subclass describing the payload.
+    data: the payload, as a string.
+    is_64_bit_log: whether the payload comes from a 64 bit log.
+
+  Returns:
+    A tuple of the values of the fields of the event class.
+
+  Raises:
+    ValueError: the payload is malformed.
+  """
+  return _decoder.Decode(GetEventFormat(event_class), data, is_64_bit_log)
+
+
+def BatchEventHandler(*event_infos):
+  """BatchEventHandler decorator factory.
+
+  This is the batch counterpart of etw.consumer.EventHandler. The decorated
+  function receives an EventBatch rather than a single event.
+  """
+  def wrapper(func):
+    func.batch_event_infos = event_infos[:]
+    return func
+  return wrapper
+
+
+class MetaBatchEventConsumer(type):
+  """Meta class for BatchEventConsumer.
+
+  This populates the batch event handler map of a BatchEventConsumer subclass,
+  as MetaEventConsumer does for EventConsumer.
+  """
+  def __new__(cls, name, bases, dict):
+    """Create a new BatchEventConsumer class type."""
+    event_handler_map = defaultdict(list)
+    for base in bases:
+      base_map = getattr(base, 'batch_event_handler_map', None)
+      if base_map:
+        event_handler_map.update(base_map)
+    for v in dict.values():
+      event_infos = getattr(v, 'batch_event_infos', [])
+      for event_info in event_infos:
+        event_handler_map[event_info].append(v)
+    new_type = type.__new__(cls, name, bases, dict)
+    new_type.batch_event_handler_map = event_handler_map
+    return new_type
+
+
+class BatchEventConsumer(object):
+  """A batch event handler base class.
+
+  Derive your handlers from this class, and define batch event handlers like
+  so:
+
+  @BatchEventHandler(module.Event.EventName)
+  def OnEventNames(self, batch):
+    pass
+
+  Note that if any handler raises an exception, the exception will be logged,
+  and log parsing will be terminated as soon as possible.
+  """
+  __metaclass__ = MetaBatchEventConsumer
+
+
+class EventBatch(object):
+  """The events of a given class decoded from a log buffer.
+
+  Attributes:
+    event_class: the EventClass subclass describing the events.
+    field_names: the names of the fields of the records.
+    records: a list of (process_id, thread_id, raw_time_stamp, field1, ...)
+        tuples, one per event.
+  """
+  def __init__(self, event_class, records):
+    self.event_class = event_class
+    self.field_names = ([name for name, unused_type in _HEADER_FIELDS] +
+                        [name for name, unused_type in event_class._fields_])
+    self.records = records
+
+  def __len__(self):
+    return len(self.records)
+
+  def ToArray(self):
+    """Returns the records as a NumPy record array."""
+    import numpy
+    format = GetEventFormat(self.event_class)
+    dtype = _HEADER_FIELDS + [
+        (name, _NUMPY_TYPES[code])
+        for (name, unused_type), code in zip(self.event_class._fields_,
+                                             format)]
+    return numpy.rec.fromrecords(self.records, dtype=dtype)
+
+  def TimeStamps(self):
+    """Returns the time stamps of the events, in seconds since 1.1.1970."""
+    import numpy
+    raw_time_stamps = numpy.fromiter((record[2] for record in self.records),
+                                     dtype='int64',
+                                     count=len(self.records))
+    return (raw_time_stamps * util.FILETIME_TO_SECONDS_MULTIPLIER -
+            util.FILETIME_EPOCH_DELTA_S)
+
+
+class BatchTraceEventSource(object):
+  """A trace consumer that decodes events natively, in batches.
+
+  This is the batch counterpart of etw.consumer.TraceEventSource. It consumes
+  log files only.
+  """
+
+  def __init__(self, handlers=[]):
+    """Creates an idle consumer.
+
+    Args:
+      handlers: an optional list of handlers to consume the log(s).
+          Each handler should be an object derived from BatchEventConsumer.
+    """
+    self._handlers = handlers[:]
+    self._log_files = []
+    self._stop = False
+    self.decoded_events = 0
+    self.malformed_events = 0
+
+  def AddHandler(self, handler):
+    """Add a new handler to this consumer.
+
+    Args:
+      handler: the handler to add.
+    """
+    self._handlers.append(handler)
+
+  def OpenFileSession(self, path):
+    """Adds the file at "path" to the files to consume.
+
+    Args:
+      path: relative or absolute path to the file to consume.
+    """
+    self._log_files.append(unicode(path))
+
+  def Consume(self):
+    """Consume all the files added, dispatching their events in batches."""
+    self._stop = False
+    formats = {}
+    handlers = {}
+    for key, event_class in event.EventClass._subclass_map.items():
+      guid, version, kind = key
+      key_handlers = self._GetHandlers(guid, kind)
+      if not key_handlers:
+        continue
+      guid_bytes = uuid.UUID(guid).bytes_le
+      formats[key] = (guid_bytes, version, kind,
+                      GetEventFormat(event_class))
+      handlers[key] = (event_class, key_handlers)
+
+    def OnRecords(key, records):
+      event_class, key_handlers = handlers[key]
+      batch = EventBatch(event_class, records)
+      try:
+        for handler in key_handlers:
+          handler(batch)
+      except:
+        # Terminate parsing on exception.
+        logging.exception('Exception in batch handler, terminating parsing')
+        self._stop = True
+      return not self._stop
+
+    self.decoded_events, self.malformed_events = _decoder.Consume(
+        self._log_files, formats, OnRecords)
+
+  def Stop(self):
+    """Stops the consumption once the current batch has been dispatched."""
+    self._stop = True
+
+  def _GetHandlers(self, guid, kind):
+    key = (guid, kind)
+    handler_list = []
+    for handler_instance in self._handlers:
+      for handler_func in handler_instance.batch_event_handler_map.get(key,
+                                                                       []):
+        handler_list.append(_BindHandler(handler_func, handler_instance))
+    return handler_list
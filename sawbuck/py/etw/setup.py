@@ -19,7 +19,7 @@ print sys.version
 from ez_setup import use_setuptools
 use_setuptools()
 
-from setuptools import setup
+from setuptools import Extension, setup
 
 
 setup(name = 'ETW',
@@ -29,6 +29,9 @@ setup(name = 'ETW',
       author_email = 'siggi@chromium.org',
       url = 'http://code.google.com/p/sawbuck',
       packages = ['etw', 'etw.descriptors'],
+      ext_modules = [Extension('etw._decoder',
+                               sources = ['etw/_decoder.cc'],
+                               libraries = ['advapi32'])],
       tests_require = ["nose>=0.9.2"],
       test_suite = 'nose.collector',
       license = 'Apache 2.0')
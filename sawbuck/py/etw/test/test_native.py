@@ -0,0 +1,135 @@
+#!python
+# Copyright 2013 Google Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""Unit test for the etw.native module."""
+from etw import consumer
+from etw import native
+from etw.descriptors import event
+from etw.descriptors import field
+from etw.descriptors import image
+import os
+import struct
+import unittest
+
+
+_SRC_DIR = os.path.abspath(os.path.join(__file__, '../../../../..'))
+
+
+class TestEventClass(event.EventClass):
+  _fields_ = [('TestString', field.String),
+              ('TestWString', field.WString),
+              ('TestInt32', field.Int32),
+              ('TestPointer', field.Pointer),
+              ('TestBoolean', field.Boolean)]
+
+
+class DecodeTest(unittest.TestCase):
+  def testFormat(self):
+    self.assertEqual('swiP?', native.GetEventFormat(TestEventClass))
+
+  def testDecode(self):
+    data = ('Hello\0' + u'World\0'.encode('utf-16-le') +
+            struct.pack('<iI?', -1234, 0x12345678, True))
+    self.assertEqual(('Hello', u'World', -1234, 0x12345678, True),
+                     native.Decode(TestEventClass, data))
+
+  def testDecode64(self):
+    data = ('\0' + u'\0'.encode('utf-16-le') +
+            struct.pack('<iQ?', 1, 0x123456789A, False))
+    self.assertEqual(('', u'', 1, 0x123456789A, False),
+                     native.Decode(TestEventClass, data, True))
+
+  def testBadBuffer(self):
+    # The string isn't terminated.
+    self.assertRaises(ValueError, native.Decode, TestEventClass, 'Hello')
+    # The trailing fields are missing.
+    data = 'Hello\0' + u'World\0'.encode('utf-16-le') + struct.pack('<i', 1)
+    self.assertRaises(ValueError, native.Decode, TestEventClass, data)
+
+
+class BatchTraceEventSourceTest(unittest.TestCase):
+  _TEST_LOG = os.path.normpath(
+      os.path.join(_SRC_DIR,
+                   'sawbuck/log_lib/test_data/image_data_32_v2.etl'))
+
+  def testConsumeMatchesTraceEventSource(self):
+    """Test that batch consumption decodes the same events."""
+    class TestConsumer(consumer.EventConsumer):
+      def __init__(self):
+        super(TestConsumer, self).__init__()
+        self.images = []
+
+      @consumer.EventHandler(image.Event.Load, image.Event.DCStart)
+      def OnImage(self, event_data):
+        self.images.append((event_data.process_id,
+                            event_data.ImageBase,
+                            event_data.ImageSize,
+                            event_data.FileName))
+
+    class TestBatchConsumer(native.BatchEventConsumer):
+      def __init__(self):
+        super(TestBatchConsumer, self).__init__()
+        self.images = []
+        self.batch_sizes = []
+
+      @native.BatchEventHandler(image.Event.Load, image.Event.DCStart)
+      def OnImages(self, batch):
+        array = batch.ToArray()
+        self.batch_sizes.append(
+            (len(batch), len(array), len(batch.TimeStamps())))
+        for record in array:
+          self.images.append((record.process_id,
+                              record.ImageBase,
+                              record.ImageSize,
+                              record.FileName))
+
+    expected = TestConsumer()
+    source = consumer.TraceEventSource([expected])
+    source.OpenFileSession(self._TEST_LOG)
+    source.Consume()
+
+    actual = TestBatchConsumer()
+    batch_source = native.BatchTraceEventSource([actual])
+    batch_source.OpenFileSession(self._TEST_LOG)
+    batch_source.Consume()
+
+    self.assertTrue(len(expected.images) > 10)
+    self.assertNotEqual(0, len(actual.batch_sizes))
+    for size, array_size, time_stamps_size in actual.batch_sizes:
+      self.assertEqual(size, array_size)
+      self.assertEqual(size, time_stamps_size)
+    self.assertEqual(0, batch_source.malformed_events)
+    self.assertEqual(sorted(expected.images), sorted(actual.images))
+
+  def testThrowFromHandler(self):
+    """Test that throwing from a handler terminates processing."""
+    class TestBatchConsumer(native.BatchEventConsumer):
+      def __init__(self):
+        super(TestBatchConsumer, self).__init__()
+        self.batches = 0
+
+      @native.BatchEventHandler(image.Event.Load, image.Event.DCStart)
+      def OnImages(self, batch):
+        self.batches += 1
+        raise RuntimeError('Intentionally throwing')
+
+    batch_consumer = TestBatchConsumer()
+    batch_source = native.BatchTraceEventSource([batch_consumer])
+    batch_source.OpenFileSession(self._TEST_LOG)
+    batch_source.Consume()
+    self.assertEqual(1, batch_consumer.batches)
+
+
+if __name__ == '__main__':
+  unittest.main()
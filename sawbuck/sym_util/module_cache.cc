@@ -29,14 +29,10 @@ void ModuleCache::ModuleLoaded(ProcessId pid,
                                const ModuleInformation& module) {
   ModuleStateKey key(pid, time);
 
-  // Find the state we have for this process.
-  ModuleLoadState state(GetStateForProcess(key));
-
-  // Add the new module.
-  state.insert(GetModuleId(module));
-
-  // And store it.
-  SetProcessState(key, GetModuleLoadStateId(state));
+  // Find the state we have for this process, add the new module,
+  // and store it.
+  ModuleLoadStateId id = GetStateIdForProcess(key);
+  SetProcessState(key, GetNextStateId(id, GetModuleId(module), true));
 }
 
 void ModuleCache::ModuleUnloaded(ProcessId pid,
@@ -44,14 +40,14 @@ void ModuleCache::ModuleUnloaded(ProcessId pid,
                                  const ModuleInformation& module) {
   ModuleStateKey key(pid, time);
 
-  // Find the state we have for this process.
-  ModuleLoadState state(GetStateForProcess(key));
-
-  // Remove the module.
-  state.erase(GetModuleId(module));
+  // Find the state we have for this process, remove the module,
+  // and store it.
+  ModuleLoadStateId id = GetStateIdForProcess(key);
+  SetProcessState(key, GetNextStateId(id, GetModuleId(module), false));
+}
 
-  // And store it.
-  SetProcessState(key, GetModuleLoadStateId(state));
+void ModuleCache::ProcessEnded(ProcessId pid, const base::Time& time) {
+  SetProcessState(ModuleStateKey(pid, time), kInvalidModuleLoadState);
 }
 
 bool ModuleCache::GetProcessModuleState(
@@ -97,15 +93,20 @@ const ModuleInformation& ModuleCache::GetModule(ModuleId id) {
 }
 
 ModuleCache::ModuleLoadStateId ModuleCache::GetModuleLoadStateId(
-    const ModuleLoadState& state) {
-  ModuleLoadStateMap::iterator it(module_load_state_ids_.find(state));
-
-  if (it != module_load_state_ids_.end())
-    return it->second;
+    const ModuleLoadState& state, ModuleLoadStateHash hash) {
+  // Only the states with the same hash need to be compared.
+  std::pair<ModuleLoadStateHashMap::iterator,
+            ModuleLoadStateHashMap::iterator> range(
+      module_load_state_ids_.equal_range(hash));
+  for (; range.first != range.second; ++range.first) {
+    if (module_load_states_[range.first->second] == state)
+      return range.first->second;
+  }
 
   ModuleLoadStateId id = next_module_load_state_id_++;
-  module_load_state_ids_.insert(std::make_pair(state, id));
+  module_load_state_ids_.insert(std::make_pair(hash, id));
   module_load_states_.push_back(state);
+  module_load_state_hashes_.push_back(hash);
 
   return id;
 }
@@ -115,6 +116,43 @@ const ModuleCache::ModuleLoadState& ModuleCache::GetModuleLoadState(
   return module_load_states_[id];
 }
 
+ModuleCache::ModuleLoadStateId ModuleCache::GetNextStateId(
+    ModuleLoadStateId id, ModuleId module_id, bool loaded) {
+  TransitionMap& transitions =
+      loaded ? load_transitions_ : unload_transitions_;
+  Transition transition(id, module_id);
+  TransitionMap::iterator it(transitions.find(transition));
+  if (it != transitions.end())
+    return it->second;
+
+  ModuleLoadState state;
+  ModuleLoadStateHash hash = 0;
+  if (id != kInvalidModuleLoadState) {
+    state = GetModuleLoadState(id);
+    hash = module_load_state_hashes_[id];
+  }
+
+  if (loaded) {
+    if (state.insert(module_id).second)
+      hash += HashModuleId(module_id);
+  } else {
+    if (state.erase(module_id) != 0)
+      hash -= HashModuleId(module_id);
+  }
+
+  ModuleLoadStateId next_id = GetModuleLoadStateId(state, hash);
+  transitions.insert(std::make_pair(transition, next_id));
+
+  return next_id;
+}
+
+// static
+ModuleCache::ModuleLoadStateHash ModuleCache::HashModuleId(ModuleId id) {
+  // Scatter the ids, so that the sums of different sets rarely collide.
+  ModuleLoadStateHash hash = id * 0x9E3779B1U;
+  return hash ^ (hash >> 15);
+}
+
 ModuleCache::ModuleLoadStateId ModuleCache::GetStateIdForProcess(
     const ModuleStateKey& key) {
   ProcessLoadStateMap::iterator it(process_states_.upper_bound(key));
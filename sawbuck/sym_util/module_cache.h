@@ -20,6 +20,7 @@
 #include <map>
 #include <set>
 #include <string>
+#include <utility>
 #include <vector>
 #include "sawbuck/sym_util/types.h"
 
@@ -41,6 +42,9 @@ class ModuleCache {
   void ModuleUnloaded(ProcessId pid,
                       const base::Time& time,
                       const ModuleInformation& module);
+  // Process @p pid ended at @p time, so it has no modules from then on, and
+  // a later process reusing its id starts out with none.
+  void ProcessEnded(ProcessId pid, const base::Time& time);
 
   // Retrieve the module state for process @p pid at @p time.
   bool GetProcessModuleState(ProcessId pid,
@@ -78,16 +82,42 @@ class ModuleCache {
   // you have multiple instances of the same executable running, we
   // encode entire module load states into an integer as well.
   typedef std::set<ModuleId> ModuleLoadState;
-  typedef std::map<ModuleLoadState, ModuleLoadStateId> ModuleLoadStateMap;
-  // Maps from module load state to id.
-  ModuleLoadStateMap module_load_state_ids_;
-  // Maps from id to module load state.
+  // Each module load state is hashed as the sum of the hashes of its
+  // modules, which is updated in constant time as modules come and go.
+  typedef size_t ModuleLoadStateHash;
+  typedef std::multimap<ModuleLoadStateHash, ModuleLoadStateId>
+      ModuleLoadStateHashMap;
+  // Maps from module load state hash to the ids of the states with that hash.
+  ModuleLoadStateHashMap module_load_state_ids_;
+  // Maps from id to module load state, and to its hash.
   std::vector<ModuleLoadState> module_load_states_;
+  std::vector<ModuleLoadStateHash> module_load_state_hashes_;
   ModuleId next_module_load_state_id_;
 
-  ModuleLoadStateId GetModuleLoadStateId(const ModuleLoadState& state);
+  ModuleLoadStateId GetModuleLoadStateId(const ModuleLoadState& state,
+                                         ModuleLoadStateHash hash);
   const ModuleLoadState& GetModuleLoadState(ModuleLoadStateId id);
 
+  // Processes tend to load and unload the same modules in the same order,
+  // so we remember the state each load or unload leads to from each state.
+  // This spares copying and interning the state in the common case.
+  typedef std::pair<ModuleLoadStateId, ModuleId> Transition;
+  typedef std::map<Transition, ModuleLoadStateId> TransitionMap;
+  TransitionMap load_transitions_;
+  TransitionMap unload_transitions_;
+
+  // Retrieves the state that loading or unloading a module leads to.
+  // @param id the current state, or kInvalidModuleLoadState for none.
+  // @param module_id the module loaded or unloaded.
+  // @param loaded true if the module is loaded, false if it's unloaded.
+  // @returns the id of the resulting state.
+  ModuleLoadStateId GetNextStateId(ModuleLoadStateId id,
+                                   ModuleId module_id,
+                                   bool loaded);
+
+  // Returns the contribution of a module to the hash of a state.
+  static ModuleLoadStateHash HashModuleId(ModuleId id);
+
   struct ModuleStateKey {
     ModuleStateKey(ProcessId pid, const base::Time& time)
         : pid_(pid), time_(time) {
@@ -70,6 +70,73 @@ TEST(ModuleCacheTest, Insert) {
             cache.GetStateId(kPid1, t2 + base::TimeDelta::FromMilliseconds(1)));
 }
 
+TEST(ModuleCacheTest, SharedStates) {
+  const ProcessId kPid2 = 43;
+  ModuleCache cache;
+
+  ModuleInformation mod1 = { 0 };
+  mod1.image_file_name = L"foo.dll";
+  ModuleInformation mod2 = { 0 };
+  mod2.image_file_name = L"bar.dll";
+
+  base::Time t0(base::Time::Now());
+  base::Time t1(t0 + base::TimeDelta::FromMilliseconds(10));
+  base::Time t2(t1 + base::TimeDelta::FromMilliseconds(10));
+
+  // Load the same modules into two processes, in different orders.
+  cache.ModuleLoaded(kPid1, t0, mod1);
+  cache.ModuleLoaded(kPid1, t1, mod2);
+  cache.ModuleLoaded(kPid2, t0, mod2);
+  cache.ModuleLoaded(kPid2, t1, mod1);
+
+  EXPECT_NE(cache.GetStateId(kPid1, t0), cache.GetStateId(kPid2, t0));
+  EXPECT_EQ(cache.GetStateId(kPid1, t1), cache.GetStateId(kPid2, t1));
+
+  // Unloading leads back to the earlier states.
+  cache.ModuleUnloaded(kPid1, t2, mod2);
+  cache.ModuleUnloaded(kPid2, t2, mod2);
+  EXPECT_EQ(cache.GetStateId(kPid1, t0), cache.GetStateId(kPid1, t2));
+  EXPECT_EQ(cache.GetStateId(kPid1, t2), cache.GetStateId(kPid2, t2));
+
+  // Loading a module twice doesn't change the state.
+  base::Time t3(t2 + base::TimeDelta::FromMilliseconds(10));
+  cache.ModuleLoaded(kPid1, t3, mod1);
+  EXPECT_EQ(cache.GetStateId(kPid1, t2), cache.GetStateId(kPid1, t3));
+
+  std::vector<ModuleInformation> modules;
+  EXPECT_TRUE(cache.GetProcessModuleState(kPid2, t2, &modules));
+  ASSERT_EQ(1, modules.size());
+  EXPECT_STREQ(L"foo.dll", modules[0].image_file_name.c_str());
+}
+
+TEST(ModuleCacheTest, ProcessEnded) {
+  ModuleCache cache;
+
+  ModuleInformation mod1 = { 0 };
+  mod1.image_file_name = L"foo.dll";
+  ModuleInformation mod2 = { 0 };
+  mod2.image_file_name = L"bar.dll";
+
+  base::Time t0(base::Time::Now());
+  base::Time t1(t0 + base::TimeDelta::FromMilliseconds(10));
+  base::Time t2(t1 + base::TimeDelta::FromMilliseconds(10));
+
+  cache.ModuleLoaded(kPid1, t0, mod1);
+  cache.ProcessEnded(kPid1, t1);
+
+  std::vector<ModuleInformation> modules;
+  EXPECT_TRUE(cache.GetProcessModuleState(kPid1, t0, &modules));
+  EXPECT_FALSE(cache.GetProcessModuleState(kPid1, t1, &modules));
+  EXPECT_TRUE(modules.empty());
+
+  // A new process with the same id starts from scratch.
+  cache.ModuleLoaded(kPid1, t2, mod2);
+  EXPECT_TRUE(cache.GetProcessModuleState(kPid1, t2, &modules));
+  ASSERT_EQ(1, modules.size());
+  EXPECT_STREQ(L"bar.dll", modules[0].image_file_name.c_str());
+  EXPECT_NE(cache.GetStateId(kPid1, t0), cache.GetStateId(kPid1, t2));
+}
+
 }  //  namespace sym_util
 
 
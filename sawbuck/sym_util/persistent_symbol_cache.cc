@@ -0,0 +1,216 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "sawbuck/sym_util/persistent_symbol_cache.h"
+
+#include <vector>
+#include "base/file_util.h"
+#include "base/logging.h"
+#include "base/string_number_conversions.h"
+#include "base/string_split.h"
+#include "base/utf_string_conversions.h"
+
+namespace sym_util {
+
+namespace {
+
+// The first line of a cache file, which identifies its format. Each
+// following line holds a symbol, as a list of tab separated UTF-8 fields.
+const char kHeader[] = "Sawbuck symbol cache v1";
+
+enum Field {
+  IMAGE_FILE_NAME,
+  MODULE_SIZE,
+  IMAGE_CHECKSUM,
+  TIME_DATE_STAMP,
+  MODULE_OFFSET,
+  MODULE,
+  NAME,
+  MANGLED_NAME,
+  OFFSET,
+  SIZE,
+  SOURCE_FILE,
+  SOURCE_LINE,
+
+  // Must be last.
+  NUM_FIELDS
+};
+
+// Returns true iff @p str can be stored in a field.
+bool IsValidField(const std::wstring& str) {
+  return str.find_first_of(L"\t\r\n") == std::wstring::npos;
+}
+
+bool ParseInt(const std::string& str, int64* value) {
+  return base::StringToInt64(str, value) && *value >= 0;
+}
+
+}  // namespace
+
+PersistentSymbolCache::PersistentSymbolCache() : dirty_(false) {
+}
+
+bool PersistentSymbolCache::Find(const ModuleInformation& module,
+                                 Address address,
+                                 Symbol* symbol) const {
+  DCHECK(symbol != NULL);
+
+  SymbolMap::const_iterator it = symbols_.find(GetKey(module, address));
+  if (it == symbols_.end())
+    return false;
+
+  *symbol = it->second;
+  symbol->module_base = module.base_address;
+  return true;
+}
+
+void PersistentSymbolCache::Insert(const ModuleInformation& module,
+                                   Address address,
+                                   const Symbol& symbol) {
+  if (symbols_.size() >= kMaxSymbols)
+    return;
+
+  if (symbols_.insert(std::make_pair(GetKey(module, address), symbol)).second)
+    dirty_ = true;
+}
+
+void PersistentSymbolCache::Clear() {
+  if (!symbols_.empty())
+    dirty_ = true;
+  symbols_.clear();
+}
+
+bool PersistentSymbolCache::Load(const FilePath& path) {
+  std::string contents;
+  if (!file_util::ReadFileToString(path, &contents))
+    return false;
+
+  std::vector<std::string> lines;
+  base::SplitString(contents, '\n', &lines);
+  if (lines.empty() || lines[0] != kHeader) {
+    LOG(ERROR) << "Invalid symbol cache file: " << path.value();
+    return false;
+  }
+
+  SymbolMap symbols;
+  for (size_t i = 1; i < lines.size() && symbols.size() < kMaxSymbols; ++i) {
+    if (lines[i].empty())
+      continue;
+
+    std::vector<std::string> fields;
+    base::SplitStringDontTrim(lines[i], '\t', &fields);
+
+    int64 module_size = 0;
+    int64 image_checksum = 0;
+    int64 time_date_stamp = 0;
+    int64 module_offset = 0;
+    int64 offset = 0;
+    int64 size = 0;
+    int64 line = 0;
+    if (fields.size() != NUM_FIELDS ||
+        !ParseInt(fields[MODULE_SIZE], &module_size) ||
+        !ParseInt(fields[IMAGE_CHECKSUM], &image_checksum) ||
+        !ParseInt(fields[TIME_DATE_STAMP], &time_date_stamp) ||
+        !ParseInt(fields[MODULE_OFFSET], &module_offset) ||
+        !ParseInt(fields[OFFSET], &offset) ||
+        !ParseInt(fields[SIZE], &size) ||
+        !ParseInt(fields[SOURCE_LINE], &line)) {
+      LOG(ERROR) << "Invalid symbol on line " << i + 1 << " of "
+                 << path.value();
+      return false;
+    }
+
+    ModuleInformation module = {};
+    module.module_size = static_cast<ModuleSize>(module_size);
+    module.image_checksum = static_cast<ModuleChecksum>(image_checksum);
+    module.time_date_stamp = static_cast<ModuleTimeDateStamp>(time_date_stamp);
+    module.image_file_name = UTF8ToWide(fields[IMAGE_FILE_NAME]);
+
+    Symbol symbol;
+    symbol.module = UTF8ToWide(fields[MODULE]);
+    symbol.module_base = 0;
+    symbol.name = UTF8ToWide(fields[NAME]);
+    symbol.mangled_name = UTF8ToWide(fields[MANGLED_NAME]);
+    symbol.offset = static_cast<size_t>(offset);
+    symbol.size = static_cast<size_t>(size);
+    symbol.file = UTF8ToWide(fields[SOURCE_FILE]);
+    symbol.line = static_cast<size_t>(line);
+
+    symbols.insert(std::make_pair(ModuleOffset(module, module_offset),
+                                  symbol));
+  }
+
+  symbols_.swap(symbols);
+  dirty_ = false;
+  return true;
+}
+
+bool PersistentSymbolCache::Save(const FilePath& path) {
+  std::string contents(kHeader);
+  contents += '\n';
+
+  SymbolMap::const_iterator it = symbols_.begin();
+  for (; it != symbols_.end(); ++it) {
+    const ModuleInformation& module = it->first.first;
+    const Symbol& symbol = it->second;
+    if (!IsValidField(module.image_file_name) ||
+        !IsValidField(symbol.module) ||
+        !IsValidField(symbol.name) ||
+        !IsValidField(symbol.mangled_name) ||
+        !IsValidField(symbol.file)) {
+      continue;
+    }
+
+    std::string fields[NUM_FIELDS];
+    fields[IMAGE_FILE_NAME] = WideToUTF8(module.image_file_name);
+    fields[MODULE_SIZE] = base::Int64ToString(module.module_size);
+    fields[IMAGE_CHECKSUM] = base::Int64ToString(module.image_checksum);
+    fields[TIME_DATE_STAMP] = base::Int64ToString(module.time_date_stamp);
+    fields[MODULE_OFFSET] = base::Int64ToString(it->first.second);
+    fields[MODULE] = WideToUTF8(symbol.module);
+    fields[NAME] = WideToUTF8(symbol.name);
+    fields[MANGLED_NAME] = WideToUTF8(symbol.mangled_name);
+    fields[OFFSET] = base::Int64ToString(symbol.offset);
+    fields[SIZE] = base::Int64ToString(symbol.size);
+    fields[SOURCE_FILE] = WideToUTF8(symbol.file);
+    fields[SOURCE_LINE] = base::Int64ToString(symbol.line);
+
+    for (size_t i = 0; i < NUM_FIELDS; ++i) {
+      if (i != 0)
+        contents += '\t';
+      contents += fields[i];
+    }
+    contents += '\n';
+  }
+
+  int size = static_cast<int>(contents.size());
+  if (file_util::WriteFile(path, contents.data(), size) != size) {
+    LOG(ERROR) << "Failed to write symbol cache to " << path.value();
+    return false;
+  }
+
+  dirty_ = false;
+  return true;
+}
+
+// static
+PersistentSymbolCache::ModuleOffset PersistentSymbolCache::GetKey(
+    const ModuleInformation& module, Address address) {
+  DCHECK_GE(address, module.base_address);
+
+  ModuleOffset key(module, address - module.base_address);
+  key.first.base_address = 0;
+  return key;
+}
+
+}  // namespace sym_util
@@ -0,0 +1,86 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A cache of resolved symbols that can be saved to, and loaded from disk.
+#ifndef SAWBUCK_SYM_UTIL_PERSISTENT_SYMBOL_CACHE_H_
+#define SAWBUCK_SYM_UTIL_PERSISTENT_SYMBOL_CACHE_H_
+
+#include <map>
+#include <string>
+#include <utility>
+#include "base/basictypes.h"
+#include "base/file_path.h"
+#include "sawbuck/sym_util/types.h"
+
+namespace sym_util {
+
+// Caches resolved symbols keyed on the signature of their module - its image
+// name, size, checksum and timestamp - and on their offset in the module.
+// The base address of the modules doesn't matter, so processes that load the
+// same module at different addresses share the symbols, as do sessions
+// loading the cache from disk.
+class PersistentSymbolCache {
+ public:
+  PersistentSymbolCache();
+
+  // Looks up the symbol for @p address in @p module.
+  // @returns true and sets @p symbol on a hit, false otherwise.
+  bool Find(const ModuleInformation& module,
+            Address address,
+            Symbol* symbol) const;
+
+  // Stores the symbol for @p address in @p module. Once the cache is full,
+  // new symbols are dropped.
+  void Insert(const ModuleInformation& module,
+              Address address,
+              const Symbol& symbol);
+
+  // Removes all the symbols from the cache.
+  void Clear();
+
+  // Returns the number of cached symbols.
+  size_t size() const { return symbols_.size(); }
+
+  // Returns true iff symbols were added or removed since the last Load or
+  // Save.
+  bool dirty() const { return dirty_; }
+
+  // Replaces the contents of the cache with that of the file at @p path.
+  // @returns true on success, false if the file is missing or invalid.
+  bool Load(const FilePath& path);
+
+  // Writes the contents of the cache to the file at @p path.
+  // @returns true on success, false otherwise.
+  bool Save(const FilePath& path);
+
+  // The maximum number of symbols held by the cache.
+  static const size_t kMaxSymbols = 64 * 1024;
+
+ private:
+  // The module, with its base address zeroed, and the offset in the module.
+  typedef std::pair<ModuleInformation, Address> ModuleOffset;
+  typedef std::map<ModuleOffset, Symbol> SymbolMap;
+
+  // Returns the key of @p address in @p module.
+  static ModuleOffset GetKey(const ModuleInformation& module, Address address);
+
+  SymbolMap symbols_;
+  bool dirty_;
+
+  DISALLOW_COPY_AND_ASSIGN(PersistentSymbolCache);
+};
+
+}  // namespace sym_util
+
+#endif  // SAWBUCK_SYM_UTIL_PERSISTENT_SYMBOL_CACHE_H_
@@ -0,0 +1,129 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Persistent symbol cache unittests.
+#include "sawbuck/sym_util/persistent_symbol_cache.h"
+
+#include "base/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "gtest/gtest.h"
+
+namespace sym_util {
+
+namespace {
+
+ModuleInformation CreateModule(ModuleBase base_address) {
+  ModuleInformation module = { 0 };
+  module.base_address = base_address;
+  module.module_size = 0x10000;
+  module.image_checksum = 0xCAFEBABE;
+  module.time_date_stamp = 0x12345678;
+  module.image_file_name = L"C:\\foo\\foo.dll";
+  return module;
+}
+
+Symbol CreateSymbol(ModuleBase module_base) {
+  Symbol symbol;
+  symbol.module = L"foo";
+  symbol.module_base = module_base;
+  symbol.name = L"Foo";
+  symbol.mangled_name = L"?Foo@@YAXXZ";
+  symbol.offset = 4;
+  symbol.size = 16;
+  symbol.file = L"c:\\src\\foo.cc";
+  symbol.line = 42;
+  return symbol;
+}
+
+void ExpectSymbolEq(const Symbol& expected, const Symbol& symbol) {
+  EXPECT_EQ(expected.module, symbol.module);
+  EXPECT_EQ(expected.module_base, symbol.module_base);
+  EXPECT_EQ(expected.name, symbol.name);
+  EXPECT_EQ(expected.mangled_name, symbol.mangled_name);
+  EXPECT_EQ(expected.offset, symbol.offset);
+  EXPECT_EQ(expected.size, symbol.size);
+  EXPECT_EQ(expected.file, symbol.file);
+  EXPECT_EQ(expected.line, symbol.line);
+}
+
+}  // namespace
+
+TEST(PersistentSymbolCacheTest, FindAndInsert) {
+  PersistentSymbolCache cache;
+  EXPECT_FALSE(cache.dirty());
+
+  ModuleInformation module = CreateModule(0x10000000);
+  Symbol symbol;
+  EXPECT_FALSE(cache.Find(module, 0x10001000, &symbol));
+
+  cache.Insert(module, 0x10001000, CreateSymbol(0x10000000));
+  EXPECT_TRUE(cache.dirty());
+  EXPECT_EQ(1U, cache.size());
+  ASSERT_TRUE(cache.Find(module, 0x10001000, &symbol));
+  ExpectSymbolEq(CreateSymbol(0x10000000), symbol);
+  EXPECT_FALSE(cache.Find(module, 0x10001001, &symbol));
+
+  // The same module loaded elsewhere shares the symbol.
+  ModuleInformation relocated = CreateModule(0x20000000);
+  ASSERT_TRUE(cache.Find(relocated, 0x20001000, &symbol));
+  ExpectSymbolEq(CreateSymbol(0x20000000), symbol);
+
+  // But another build of the module doesn't.
+  ModuleInformation rebuilt = CreateModule(0x10000000);
+  rebuilt.time_date_stamp += 1;
+  EXPECT_FALSE(cache.Find(rebuilt, 0x10001000, &symbol));
+
+  cache.Clear();
+  EXPECT_EQ(0U, cache.size());
+  EXPECT_FALSE(cache.Find(module, 0x10001000, &symbol));
+}
+
+TEST(PersistentSymbolCacheTest, SaveAndLoad) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  FilePath path(temp_dir.path().Append(L"symbols.txt"));
+
+  PersistentSymbolCache cache;
+  EXPECT_FALSE(cache.Load(path));
+
+  ModuleInformation module = CreateModule(0x10000000);
+  cache.Insert(module, 0x10001000, CreateSymbol(0x10000000));
+
+  // Symbols that can't be stored are skipped.
+  Symbol invalid = CreateSymbol(0x10000000);
+  invalid.name = L"Foo\tBar";
+  cache.Insert(module, 0x10002000, invalid);
+
+  ASSERT_TRUE(cache.Save(path));
+  EXPECT_FALSE(cache.dirty());
+
+  PersistentSymbolCache loaded;
+  ASSERT_TRUE(loaded.Load(path));
+  EXPECT_FALSE(loaded.dirty());
+  EXPECT_EQ(1U, loaded.size());
+
+  Symbol symbol;
+  ModuleInformation relocated = CreateModule(0x20000000);
+  ASSERT_TRUE(loaded.Find(relocated, 0x20001000, &symbol));
+  ExpectSymbolEq(CreateSymbol(0x20000000), symbol);
+
+  // Invalid files are rejected.
+  const char kInvalid[] = "Not a symbol cache\n";
+  ASSERT_EQ(static_cast<int>(sizeof(kInvalid) - 1),
+            file_util::WriteFile(path, kInvalid, sizeof(kInvalid) - 1));
+  EXPECT_FALSE(loaded.Load(path));
+  EXPECT_EQ(1U, loaded.size());
+}
+
+}  // namespace sym_util
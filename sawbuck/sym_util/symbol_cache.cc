@@ -132,6 +132,19 @@ bool SymbolCache::GetSymbolForAddress(Address address, Symbol *symbol) {
   return true;
 }
 
+bool SymbolCache::GetModuleForAddress(Address address,
+                                      ModuleInformation* info) const {
+  for (size_t i = 0; i < modules_.size(); ++i) {
+    if (address >= modules_[i].base_address &&
+        address - modules_[i].base_address < modules_[i].module_size) {
+      *info = modules_[i];
+      return true;
+    }
+  }
+
+  return false;
+}
+
 void SymbolCache::Cleanup() {
   if (initialized_)
     ::SymCleanup(process_handle_);
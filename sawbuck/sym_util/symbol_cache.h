@@ -39,6 +39,12 @@ class SymbolCache {
 
   bool GetSymbolForAddress(Address address, Symbol *symbol);
 
+  // Retrieves the module that spans @p address, if any.
+  bool GetModuleForAddress(Address address, ModuleInformation* info) const;
+
+  // Returns the number of modules we were initialized with.
+  size_t num_modules() const { return modules_.size(); }
+
   // Initialize to the set of modules provided.
   bool Initialize(size_t num_modules, ModuleInformation* modules);
   void Cleanup();
@@ -0,0 +1,77 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Column index implementation.
+#include "sawbuck/viewer/column_index.h"
+
+#include "base/logging.h"
+
+namespace {
+
+// The estimated overhead of a value in a value map.
+const size_t kValueOverhead = 4 * sizeof(void*);
+
+}  // namespace
+
+ColumnIndex::ColumnIndex() {
+}
+
+ColumnIndex::~ColumnIndex() {
+}
+
+void ColumnIndex::AddRow(int row, int severity, int process_id,
+                         int thread_id) {
+  values_[SEVERITY][severity].Add(row);
+  values_[PROCESS_ID][process_id].Add(row);
+  values_[THREAD_ID][thread_id].Add(row);
+}
+
+void ColumnIndex::Clear() {
+  for (size_t i = 0; i < NUM_COLUMNS; ++i)
+    values_[i].clear();
+}
+
+void ColumnIndex::GetRows(Column column,
+                          const std::vector<int>& values,
+                          int start,
+                          int end,
+                          RowBitmap* rows) const {
+  DCHECK_LT(column, NUM_COLUMNS);
+  DCHECK(rows != NULL);
+
+  rows->Clear();
+  RowBitmap range;
+  range.AddRange(start, end);
+
+  const ValueMap& value_map = values_[column];
+  for (size_t i = 0; i < values.size(); ++i) {
+    ValueMap::const_iterator it = value_map.find(values[i]);
+    if (it == value_map.end())
+      continue;
+
+    RowBitmap value_rows(range);
+    value_rows.Intersect(it->second);
+    rows->Union(value_rows);
+  }
+}
+
+size_t ColumnIndex::memory_size() const {
+  size_t size = 0;
+  for (size_t i = 0; i < NUM_COLUMNS; ++i) {
+    ValueMap::const_iterator it = values_[i].begin();
+    for (; it != values_[i].end(); ++it)
+      size += kValueOverhead + it->second.memory_size();
+  }
+  return size;
+}
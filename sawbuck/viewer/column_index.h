@@ -0,0 +1,89 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Column index declaration.
+#ifndef SAWBUCK_VIEWER_COLUMN_INDEX_H_
+#define SAWBUCK_VIEWER_COLUMN_INDEX_H_
+
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/hash_tables.h"
+#include "sawbuck/viewer/row_bitmap.h"
+
+// An incremental index of the severity, process id and thread id columns of
+// a list of rows. Each distinct value of a column maps to the bitmap of the
+// rows that hold it, so that filters on these columns are answered by
+// combining bitmaps rather than by visiting the rows.
+//
+// Sample usage:
+//
+//   ColumnIndex index;
+//   index.AddRow(0, TRACE_LEVEL_ERROR, 42, 7);
+//   ...
+//   std::vector<int> values(1, TRACE_LEVEL_ERROR);
+//   RowBitmap rows;
+//   index.GetRows(ColumnIndex::SEVERITY, values, 0, 1000, &rows);
+class ColumnIndex {
+ public:
+  // The indexed columns.
+  enum Column {
+    SEVERITY,
+    PROCESS_ID,
+    THREAD_ID,
+
+    // Must be last.
+    NUM_COLUMNS
+  };
+
+  ColumnIndex();
+  ~ColumnIndex();
+
+  // Indexes the columns of a row.
+  // @param row the row.
+  // @param severity the severity of the row.
+  // @param process_id the process id of the row.
+  // @param thread_id the thread id of the row.
+  void AddRow(int row, int severity, int process_id, int thread_id);
+
+  // Removes all the rows from the index.
+  void Clear();
+
+  // Gets the rows among [@p start, @p end) whose @p column holds any of
+  // @p values.
+  // @param column the column.
+  // @param values the values to look for.
+  // @param start the first row to consider.
+  // @param end the row past the last row to consider.
+  // @param rows receives the rows.
+  void GetRows(Column column,
+               const std::vector<int>& values,
+               int start,
+               int end,
+               RowBitmap* rows) const;
+
+  // @returns the approximate size of the index, in bytes. This visits the
+  //     whole index.
+  size_t memory_size() const;
+
+ private:
+  typedef base::hash_map<int, RowBitmap> ValueMap;
+
+  // The rows holding each value of each column.
+  ValueMap values_[NUM_COLUMNS];
+
+  DISALLOW_COPY_AND_ASSIGN(ColumnIndex);
+};
+
+#endif  // SAWBUCK_VIEWER_COLUMN_INDEX_H_
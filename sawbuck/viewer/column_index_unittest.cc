@@ -0,0 +1,78 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Column index unit tests.
+#include "sawbuck/viewer/column_index.h"
+
+#include "gtest/gtest.h"
+
+namespace {
+
+TEST(ColumnIndexTest, GetRows) {
+  ColumnIndex index;
+  EXPECT_EQ(0U, index.memory_size());
+
+  // Two processes of two threads, logging at three severities.
+  for (int row = 0; row < 1000; ++row)
+    index.AddRow(row, row % 3, 10 + row % 2, 100 + row % 4);
+  EXPECT_LT(0U, index.memory_size());
+
+  std::vector<int> values(1, 11);
+  RowBitmap rows;
+  index.GetRows(ColumnIndex::PROCESS_ID, values, 0, 1000, &rows);
+  EXPECT_EQ(500U, rows.size());
+  EXPECT_TRUE(rows.Contains(1));
+  EXPECT_FALSE(rows.Contains(2));
+
+  // The rows are restricted to the range.
+  index.GetRows(ColumnIndex::PROCESS_ID, values, 100, 200, &rows);
+  EXPECT_EQ(50U, rows.size());
+  EXPECT_FALSE(rows.Contains(99));
+  EXPECT_TRUE(rows.Contains(101));
+  EXPECT_FALSE(rows.Contains(201));
+
+  // The rows holding any of the values are retrieved.
+  values.clear();
+  values.push_back(101);
+  values.push_back(103);
+  values.push_back(42);
+  index.GetRows(ColumnIndex::THREAD_ID, values, 0, 1000, &rows);
+  EXPECT_EQ(500U, rows.size());
+  EXPECT_TRUE(rows.Contains(1));
+  EXPECT_TRUE(rows.Contains(3));
+  EXPECT_FALSE(rows.Contains(4));
+
+  values.assign(1, 2);
+  index.GetRows(ColumnIndex::SEVERITY, values, 0, 10, &rows);
+  std::vector<int> expected;
+  expected.push_back(2);
+  expected.push_back(5);
+  expected.push_back(8);
+  std::vector<int> severity_rows;
+  rows.GetRows(&severity_rows);
+  EXPECT_EQ(expected, severity_rows);
+
+  // Unknown values match no rows.
+  values.assign(1, 7);
+  index.GetRows(ColumnIndex::SEVERITY, values, 0, 1000, &rows);
+  EXPECT_TRUE(rows.empty());
+
+  index.Clear();
+  EXPECT_EQ(0U, index.memory_size());
+  values.assign(1, 11);
+  index.GetRows(ColumnIndex::PROCESS_ID, values, 0, 1000, &rows);
+  EXPECT_TRUE(rows.empty());
+}
+
+}  // namespace
@@ -0,0 +1,168 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Event rate timeline implementation.
+#include "sawbuck/viewer/event_timeline.h"
+
+#include <windows.h>
+#include <wmistr.h>
+#include <evntrace.h>
+#include <algorithm>
+
+#include "base/logging.h"
+#include "sawbuck/viewer/log_list_view.h"
+
+EventTimeline::Counts::Counts() {
+  std::fill(counts, counts + NUM_SEVERITY_CLASSES, 0);
+}
+
+void EventTimeline::Counts::Add(const Counts& other) {
+  for (size_t i = 0; i < NUM_SEVERITY_CLASSES; ++i)
+    counts[i] += other.counts[i];
+}
+
+uint32 EventTimeline::Counts::total() const {
+  uint32 total = 0;
+  for (size_t i = 0; i < NUM_SEVERITY_CLASSES; ++i)
+    total += counts[i];
+  return total;
+}
+
+EventTimeline::EventTimeline(base::TimeDelta resolution)
+    : resolution_(resolution) {
+  DCHECK_LT(0, resolution.InMicroseconds());
+}
+
+EventTimeline::~EventTimeline() {
+}
+
+void EventTimeline::AddRow(base::Time time, int severity) {
+  if (levels_.empty()) {
+    origin_ = time;
+    levels_.resize(1);
+  }
+
+  int64 offset = std::max<int64>((time - origin_).InMicroseconds(), 0);
+  size_t index = static_cast<size_t>(
+      std::min<int64>(offset / resolution_.InMicroseconds(),
+                      kMaxBuckets - 1));
+  SeverityClass severity_class = GetSeverityClass(severity);
+
+  for (size_t level = 0; level < levels_.size(); ++level) {
+    Level& buckets = levels_[level];
+    size_t bucket = index >> level;
+    if (bucket >= buckets.size())
+      buckets.resize(bucket + 1);
+    ++buckets[bucket].counts[severity_class];
+  }
+
+  // Merge the top level into a new one while it has more than one bucket.
+  while (levels_.back().size() > 1) {
+    Level above((levels_.back().size() + 1) / 2);
+    const Level& below = levels_.back();
+    for (size_t i = 0; i < below.size(); ++i)
+      above[i / 2].Add(below[i]);
+    levels_.push_back(Level());
+    levels_.back().swap(above);
+  }
+}
+
+void EventTimeline::Clear() {
+  levels_.clear();
+  origin_ = base::Time();
+}
+
+base::Time EventTimeline::end_time() const {
+  if (levels_.empty())
+    return origin_;
+  return origin_ + resolution_ * static_cast<int64>(levels_[0].size());
+}
+
+base::TimeDelta EventTimeline::GetBuckets(
+    base::Time start,
+    base::Time end,
+    size_t max_buckets,
+    base::Time* first_bucket,
+    std::vector<Counts>* buckets) const {
+  DCHECK(first_bucket != NULL);
+  DCHECK(buckets != NULL);
+
+  buckets->clear();
+  if (levels_.empty() || max_buckets == 0 || end <= start ||
+      end <= origin_ || start >= end_time()) {
+    return base::TimeDelta();
+  }
+
+  // The first level buckets that overlap the span of time.
+  int64 resolution = resolution_.InMicroseconds();
+  size_t first = static_cast<size_t>(
+      std::max<int64>((start - origin_).InMicroseconds(), 0) / resolution);
+  size_t last = static_cast<size_t>(
+      ((end - origin_).InMicroseconds() + resolution - 1) / resolution);
+  last = std::min(last, levels_[0].size());
+  DCHECK_LT(first, last);
+
+  // Pick the finest level that has few enough buckets over the span.
+  size_t level = 0;
+  while (level + 1 < levels_.size() &&
+         ((last - 1) >> level) - (first >> level) + 1 > max_buckets) {
+    ++level;
+  }
+
+  const Level& level_buckets = levels_[level];
+  size_t level_first = first >> level;
+  size_t level_last = std::min(((last - 1) >> level) + 1,
+                               level_buckets.size());
+  buckets->assign(level_buckets.begin() + level_first,
+                  level_buckets.begin() + level_last);
+
+  base::TimeDelta width = resolution_ * (GG_INT64_C(1) << level);
+  *first_bucket = origin_ + width * static_cast<int64>(level_first);
+  return width;
+}
+
+EventTimeline::SeverityClass EventTimeline::GetSeverityClass(int severity) {
+  switch (severity) {
+    case TRACE_LEVEL_FATAL:
+    case TRACE_LEVEL_ERROR:
+      return ERRORS;
+    case TRACE_LEVEL_WARNING:
+      return WARNINGS;
+    case TRACE_LEVEL_INFORMATION:
+      return INFORMATION;
+    case TRACE_LEVEL_VERBOSE:
+      return VERBOSE;
+    default:
+      return OTHER;
+  }
+}
+
+int EventTimeline::FindRowAtTime(ILogView* log_view, base::Time time) {
+  DCHECK(log_view != NULL);
+
+  int num_rows = log_view->GetNumRows();
+  if (num_rows == 0)
+    return -1;
+
+  int begin = 0;
+  int end = num_rows;
+  while (begin < end) {
+    int middle = begin + (end - begin) / 2;
+    if (log_view->GetTime(middle) < time)
+      begin = middle + 1;
+    else
+      end = middle;
+  }
+  return std::min(begin, num_rows - 1);
+}
@@ -0,0 +1,140 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Event rate timeline declaration.
+#ifndef SAWBUCK_VIEWER_EVENT_TIMELINE_H_
+#define SAWBUCK_VIEWER_EVENT_TIMELINE_H_
+
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/time.h"
+
+// Forward decl.
+class ILogView;
+
+// An incremental count of the rows of a log per time bucket and severity,
+// used to chart the rates of messages over a capture.
+//
+// The counts are kept as a pyramid of levels: the buckets of the first level
+// span the resolution of the timeline, and each level above merges pairs of
+// buckets of the level below, up to a single bucket. Adding a row updates a
+// bucket per level, and retrieving the buckets of a span of time reads them
+// from the finest level that has few enough buckets, so that zooming costs
+// no more than the buckets displayed.
+//
+// Sample usage:
+//
+//   EventTimeline timeline(base::TimeDelta::FromMilliseconds(100));
+//   timeline.AddRow(time, TRACE_LEVEL_ERROR);
+//   ...
+//   base::Time first_bucket;
+//   std::vector<EventTimeline::Counts> buckets;
+//   base::TimeDelta width =
+//       timeline.GetBuckets(start, end, 500, &first_bucket, &buckets);
+class EventTimeline {
+ public:
+  // The classes of severities the counts are split in.
+  enum SeverityClass {
+    ERRORS,
+    WARNINGS,
+    INFORMATION,
+    VERBOSE,
+    OTHER,
+
+    // Must be last.
+    NUM_SEVERITY_CLASSES
+  };
+
+  // The counts of rows of a bucket, per severity class.
+  struct Counts {
+    Counts();
+
+    // Adds the counts of @p other.
+    void Add(const Counts& other);
+
+    // @returns the number of rows of the bucket.
+    uint32 total() const;
+
+    uint32 counts[NUM_SEVERITY_CLASSES];
+  };
+
+  // @param resolution the span of time of the finest buckets.
+  explicit EventTimeline(base::TimeDelta resolution);
+  ~EventTimeline();
+
+  // Counts a row. The rows may come in any order, but those stamped before
+  // the first row are counted in the first bucket.
+  // @param time the time of the row.
+  // @param severity the severity of the row.
+  void AddRow(base::Time time, int severity);
+
+  // Removes all the rows from the timeline.
+  void Clear();
+
+  // @returns true if the timeline has no rows.
+  bool empty() const { return levels_.empty(); }
+
+  // @returns the start of the first bucket, which is the time of the first
+  //     row.
+  base::Time start_time() const { return origin_; }
+
+  // @returns the end of the last bucket.
+  base::Time end_time() const;
+
+  // Gets the buckets overlapping [@p start, @p end), at the finest
+  // resolution that needs at most @p max_buckets buckets.
+  // @param start the start of the span of time.
+  // @param end the end of the span of time.
+  // @param max_buckets the largest number of buckets to retrieve.
+  // @param first_bucket receives the start time of the first bucket.
+  // @param buckets receives the counts of the buckets, in chronological
+  //     order.
+  // @returns the span of time of each bucket, or zero if there are none.
+  base::TimeDelta GetBuckets(base::Time start,
+                             base::Time end,
+                             size_t max_buckets,
+                             base::Time* first_bucket,
+                             std::vector<Counts>* buckets) const;
+
+  // @returns the class of @p severity.
+  static SeverityClass GetSeverityClass(int severity);
+
+  // Finds the first row of @p log_view stamped at or after @p time, using a
+  // binary search on the time column. The rows are nearly in chronological
+  // order, so the row found is close to @p time even if they aren't
+  // strictly so.
+  // @returns the row, which is the last row if none is stamped after
+  //     @p time, or -1 if @p log_view has no rows.
+  static int FindRowAtTime(ILogView* log_view, base::Time time);
+
+  // The largest number of buckets of the first level. Rows stamped past the
+  // last bucket are counted in it.
+  static const size_t kMaxBuckets = 1 << 20;
+
+ private:
+  typedef std::vector<Counts> Level;
+
+  // The levels of the pyramid, the finest first.
+  std::vector<Level> levels_;
+
+  // The time of the first row, and the span of the buckets of the first
+  // level.
+  base::Time origin_;
+  base::TimeDelta resolution_;
+
+  DISALLOW_COPY_AND_ASSIGN(EventTimeline);
+};
+
+#endif  // SAWBUCK_VIEWER_EVENT_TIMELINE_H_
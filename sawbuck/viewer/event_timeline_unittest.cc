@@ -0,0 +1,142 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Event rate timeline unit tests.
+#include "sawbuck/viewer/event_timeline.h"
+
+#include <wmistr.h>
+#include <evntrace.h>
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "sawbuck/viewer/mock_log_view_interfaces.h"
+
+namespace {
+
+using testing::Return;
+using testing::StrictMock;
+
+const base::Time kOrigin = base::Time::FromDoubleT(1000000.0);
+
+base::Time GetTime(int milliseconds) {
+  return kOrigin + base::TimeDelta::FromMilliseconds(milliseconds);
+}
+
+// Returns the total number of rows of @p buckets.
+uint32 GetTotal(const std::vector<EventTimeline::Counts>& buckets) {
+  uint32 total = 0;
+  for (size_t i = 0; i < buckets.size(); ++i)
+    total += buckets[i].total();
+  return total;
+}
+
+TEST(EventTimelineTest, AddRow) {
+  EventTimeline timeline(base::TimeDelta::FromMilliseconds(10));
+  EXPECT_TRUE(timeline.empty());
+
+  timeline.AddRow(GetTime(0), TRACE_LEVEL_ERROR);
+  timeline.AddRow(GetTime(5), TRACE_LEVEL_INFORMATION);
+  timeline.AddRow(GetTime(25), TRACE_LEVEL_WARNING);
+  timeline.AddRow(GetTime(12), TRACE_LEVEL_FATAL);
+  // Rows stamped before the first row land in the first bucket.
+  timeline.AddRow(GetTime(-50), 42);
+  EXPECT_FALSE(timeline.empty());
+  EXPECT_EQ(GetTime(0), timeline.start_time());
+  EXPECT_EQ(GetTime(30), timeline.end_time());
+
+  base::Time first_bucket;
+  std::vector<EventTimeline::Counts> buckets;
+  EXPECT_EQ(base::TimeDelta::FromMilliseconds(10),
+            timeline.GetBuckets(GetTime(0), GetTime(30), 100,
+                                &first_bucket, &buckets));
+  EXPECT_EQ(GetTime(0), first_bucket);
+  ASSERT_EQ(3U, buckets.size());
+  EXPECT_EQ(1U, buckets[0].counts[EventTimeline::ERRORS]);
+  EXPECT_EQ(1U, buckets[0].counts[EventTimeline::INFORMATION]);
+  EXPECT_EQ(1U, buckets[0].counts[EventTimeline::OTHER]);
+  EXPECT_EQ(1U, buckets[1].counts[EventTimeline::ERRORS]);
+  EXPECT_EQ(1U, buckets[1].total());
+  EXPECT_EQ(1U, buckets[2].counts[EventTimeline::WARNINGS]);
+  EXPECT_EQ(1U, buckets[2].total());
+
+  timeline.Clear();
+  EXPECT_TRUE(timeline.empty());
+  EXPECT_EQ(base::TimeDelta(),
+            timeline.GetBuckets(GetTime(0), GetTime(30), 100,
+                                &first_bucket, &buckets));
+  EXPECT_TRUE(buckets.empty());
+}
+
+TEST(EventTimelineTest, GetBucketsAtCoarserLevels) {
+  EventTimeline timeline(base::TimeDelta::FromMilliseconds(1));
+  const int kNumRows = 1000;
+  for (int i = 0; i < kNumRows; ++i)
+    timeline.AddRow(GetTime(i), TRACE_LEVEL_VERBOSE);
+
+  // The whole timeline in at most 10 buckets takes buckets of 128 ms.
+  base::Time first_bucket;
+  std::vector<EventTimeline::Counts> buckets;
+  EXPECT_EQ(base::TimeDelta::FromMilliseconds(128),
+            timeline.GetBuckets(timeline.start_time(), timeline.end_time(),
+                                10, &first_bucket, &buckets));
+  EXPECT_EQ(GetTime(0), first_bucket);
+  EXPECT_EQ(8U, buckets.size());
+  EXPECT_EQ(static_cast<uint32>(kNumRows), GetTotal(buckets));
+  EXPECT_EQ(128U, buckets[0].counts[EventTimeline::VERBOSE]);
+
+  // Zooming in picks finer buckets, aligned on their span.
+  EXPECT_EQ(base::TimeDelta::FromMilliseconds(4),
+            timeline.GetBuckets(GetTime(101), GetTime(120), 8,
+                                &first_bucket, &buckets));
+  EXPECT_EQ(GetTime(100), first_bucket);
+  EXPECT_EQ(5U, buckets.size());
+  EXPECT_EQ(20U, GetTotal(buckets));
+
+  // A single bucket covers everything.
+  EXPECT_EQ(base::TimeDelta::FromMilliseconds(1024),
+            timeline.GetBuckets(GetTime(-100), GetTime(5000), 1,
+                                &first_bucket, &buckets));
+  ASSERT_EQ(1U, buckets.size());
+  EXPECT_EQ(static_cast<uint32>(kNumRows), buckets[0].total());
+
+  // Nothing lies outside of the timeline.
+  EXPECT_EQ(base::TimeDelta(),
+            timeline.GetBuckets(GetTime(2000), GetTime(3000), 10,
+                                &first_bucket, &buckets));
+  EXPECT_TRUE(buckets.empty());
+}
+
+TEST(EventTimelineTest, FindRowAtTime) {
+  StrictMock<testing::MockILogView> log_view;
+  const int kTimes[] = { 0, 10, 10, 20, 30 };
+  const int kNumRows = arraysize(kTimes);
+  EXPECT_CALL(log_view, GetNumRows()).WillRepeatedly(Return(kNumRows));
+  for (int i = 0; i < kNumRows; ++i) {
+    EXPECT_CALL(log_view, GetTime(i))
+        .WillRepeatedly(Return(GetTime(kTimes[i])));
+  }
+
+  EXPECT_EQ(0, EventTimeline::FindRowAtTime(&log_view, GetTime(-5)));
+  EXPECT_EQ(0, EventTimeline::FindRowAtTime(&log_view, GetTime(0)));
+  EXPECT_EQ(1, EventTimeline::FindRowAtTime(&log_view, GetTime(5)));
+  EXPECT_EQ(1, EventTimeline::FindRowAtTime(&log_view, GetTime(10)));
+  EXPECT_EQ(3, EventTimeline::FindRowAtTime(&log_view, GetTime(11)));
+  EXPECT_EQ(4, EventTimeline::FindRowAtTime(&log_view, GetTime(30)));
+  EXPECT_EQ(4, EventTimeline::FindRowAtTime(&log_view, GetTime(99)));
+
+  StrictMock<testing::MockILogView> empty_view;
+  EXPECT_CALL(empty_view, GetNumRows()).WillRepeatedly(Return(0));
+  EXPECT_EQ(-1, EventTimeline::FindRowAtTime(&empty_view, GetTime(0)));
+}
+
+}  // namespace
@@ -0,0 +1,306 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Compiled filter program implementation.
+#include "sawbuck/viewer/filter_program.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "base/string_number_conversions.h"
+#include "base/string_util.h"
+
+namespace {
+
+// The characters that have a meaning in a regular expression.
+const char kRegExpChars[] = "\\^$.|?*+()[]{}";
+
+// Returns true if @p pattern matches exactly the string it contains, ignoring
+// the case. The regular expressions are case-insensitive, which the literal
+// matching only reproduces for ASCII characters.
+bool IsLiteralPattern(const std::string& pattern) {
+  return IsStringASCII(pattern) &&
+      pattern.find_first_of(kRegExpChars) == std::string::npos;
+}
+
+bool CaseInsensitiveEquals(char c1, char c2) {
+  return ToLowerASCII(c1) == ToLowerASCII(c2);
+}
+
+// Returns true if the integer column @p column contains @p value.
+bool IsIntColumn(Filter::Column column) {
+  return column == Filter::PROCESS_ID || column == Filter::THREAD_ID ||
+      column == Filter::LINE;
+}
+
+}  // namespace
+
+// Fetches the values of a row from its log view on first use.
+class FilterProgram::RowValues {
+ public:
+  RowValues(ILogView* log_view, int row)
+      : log_view_(log_view), row_(row), fetched_(0) {
+    DCHECK(log_view != NULL);
+  }
+
+  int GetInt(Filter::Column column) {
+    switch (column) {
+      case Filter::PROCESS_ID:
+        return log_view_->GetProcessId(row_);
+      case Filter::THREAD_ID:
+        return log_view_->GetThreadId(row_);
+      case Filter::LINE:
+        return log_view_->GetLine(row_);
+      default:
+        NOTREACHED() << "Not an integer column.";
+        return 0;
+    }
+  }
+
+  const std::string& GetString(Filter::Column column) {
+    DCHECK_LT(column, Filter::NUM_COLUMNS);
+    std::string& value = strings_[column];
+    if ((fetched_ & (1 << column)) != 0)
+      return value;
+    fetched_ |= 1 << column;
+
+    switch (column) {
+      case Filter::FILE:
+        value = log_view_->GetFileName(row_);
+        break;
+      case Filter::MESSAGE:
+        value = log_view_->GetMessage(row_);
+        break;
+      default: {
+        LogViewFormatter formatter;
+        formatter.FormatColumn(log_view_,
+                               row_,
+                               static_cast<LogViewFormatter::Column>(column),
+                               &value);
+        break;
+      }
+    }
+    return value;
+  }
+
+ private:
+  ILogView* log_view_;
+  int row_;
+
+  // The string values of the columns, and a bit per column that's set once
+  // it has been fetched.
+  std::string strings_[Filter::NUM_COLUMNS];
+  uint32 fetched_;
+
+  DISALLOW_COPY_AND_ASSIGN(RowValues);
+};
+
+FilterProgram::FilterProgram() {
+}
+
+FilterProgram::~FilterProgram() {
+}
+
+void FilterProgram::Compile(const std::vector<Filter>& filters) {
+  inclusions_.clear();
+  exclusions_.clear();
+  regexps_.clear();
+
+  for (size_t i = 0; i < filters.size(); ++i) {
+    if (filters[i].action() == Filter::INCLUDE) {
+      AddTerm(filters[i], &inclusions_);
+    } else if (filters[i].action() == Filter::EXCLUDE) {
+      AddTerm(filters[i], &exclusions_);
+    } else {
+      NOTREACHED();
+    }
+  }
+}
+
+bool FilterProgram::Matches(ILogView* log_view, int row) const {
+  RowValues values(log_view, row);
+  if (!inclusions_.empty() && !MatchesAny(inclusions_, &values))
+    return false;
+  return !MatchesAny(exclusions_, &values);
+}
+
+void FilterProgram::AddTerm(const Filter& filter, Terms* terms) {
+  DCHECK(terms != NULL);
+
+  Term term;
+  term.column = filter.column();
+  term.int_value = 0;
+  term.regexp = NULL;
+  term.indexed = false;
+  term.index_column = ColumnIndex::NUM_COLUMNS;
+
+  std::string value = filter.value();
+  if (IsIntColumn(term.column)) {
+    if (filter.relation() == Filter::IS) {
+      term.method = INT_IS;
+      // Like Filter, use whatever prefix of the value parses.
+      base::StringToInt(value, &term.int_value);
+    } else {
+      term.method = INT_CONTAINS;
+      term.string_value = value;
+    }
+    IndexTerm(&term);
+
+    // The integer terms go first.
+    Terms::iterator it = terms->begin();
+    while (it != terms->end() && IsIntColumn(it->column))
+      ++it;
+    terms->insert(it, term);
+    return;
+  }
+
+  if (IsLiteralPattern(value)) {
+    term.method = filter.relation() == Filter::IS ? LITERAL_IS :
+                                                    LITERAL_CONTAINS;
+    term.string_value = StringToLowerASCII(value);
+  } else {
+    term.method = filter.relation() == Filter::IS ? REGEXP_IS :
+                                                    REGEXP_CONTAINS;
+    regexps_.push_back(new pcrecpp::RE(value.c_str(),
+        PCRE_NEWLINE_ANYCRLF | PCRE_DOTALL | PCRE_UTF8 | PCRE_CASELESS));
+    term.regexp = regexps_.back();
+  }
+  IndexTerm(&term);
+  terms->push_back(term);
+}
+
+void FilterProgram::IndexTerm(Term* term) {
+  DCHECK(term != NULL);
+
+  switch (term->column) {
+    case Filter::PROCESS_ID:
+    case Filter::THREAD_ID:
+      if (term->method != INT_IS)
+        return;
+      term->index_column = term->column == Filter::PROCESS_ID ?
+          ColumnIndex::PROCESS_ID : ColumnIndex::THREAD_ID;
+      term->index_values.push_back(term->int_value);
+      break;
+
+    case Filter::SEVERITY:
+      // There are few severities, so find those whose text matches.
+      term->index_column = ColumnIndex::SEVERITY;
+      for (int severity = 0; severity <= kuint8max; ++severity) {
+        if (MatchesText(*term, LogViewFormatter::GetSeverityText(severity)))
+          term->index_values.push_back(severity);
+      }
+      break;
+
+    default:
+      return;
+  }
+  term->indexed = true;
+}
+
+bool FilterProgram::GetCandidateRows(ILogViewIndex* index,
+                                     int start,
+                                     int end,
+                                     RowBitmap* rows) const {
+  DCHECK(index != NULL);
+  DCHECK(rows != NULL);
+
+  // The inclusions narrow the rows down only if they are all indexed.
+  bool narrowed = !inclusions_.empty();
+  for (size_t i = 0; i < inclusions_.size() && narrowed; ++i)
+    narrowed = inclusions_[i].indexed;
+
+  rows->Clear();
+  RowBitmap term_rows;
+  for (size_t i = 0; i < inclusions_.size() && narrowed; ++i) {
+    narrowed = GetTermRows(index, inclusions_[i], start, end, &term_rows);
+    rows->Union(term_rows);
+  }
+  if (!narrowed) {
+    rows->Clear();
+    rows->AddRange(start, end);
+  }
+
+  for (size_t i = 0; i < exclusions_.size(); ++i) {
+    if (exclusions_[i].indexed &&
+        GetTermRows(index, exclusions_[i], start, end, &term_rows)) {
+      rows->Subtract(term_rows);
+      narrowed = true;
+    }
+  }
+
+  return narrowed;
+}
+
+bool FilterProgram::GetTermRows(ILogViewIndex* index,
+                                const Term& term,
+                                int start,
+                                int end,
+                                RowBitmap* rows) {
+  DCHECK(index != NULL);
+  DCHECK(term.indexed);
+
+  return index->GetColumnRows(term.index_column, term.index_values,
+                              start, end, rows);
+}
+
+bool FilterProgram::MatchesAny(const Terms& terms, RowValues* row) {
+  DCHECK(row != NULL);
+
+  for (size_t i = 0; i < terms.size(); ++i) {
+    if (MatchesTerm(terms[i], row))
+      return true;
+  }
+  return false;
+}
+
+bool FilterProgram::MatchesTerm(const Term& term, RowValues* row) {
+  DCHECK(row != NULL);
+
+  switch (term.method) {
+    case INT_IS:
+      return row->GetInt(term.column) == term.int_value;
+
+    case INT_CONTAINS:
+      return base::IntToString(row->GetInt(term.column)).find(
+          term.string_value) != std::string::npos;
+
+    default:
+      return MatchesText(term, row->GetString(term.column));
+  }
+}
+
+bool FilterProgram::MatchesText(const Term& term, const std::string& value) {
+  switch (term.method) {
+    case LITERAL_IS:
+      return value.size() == term.string_value.size() &&
+          std::equal(value.begin(), value.end(), term.string_value.begin(),
+                     CaseInsensitiveEquals);
+
+    case LITERAL_CONTAINS:
+      return std::search(value.begin(), value.end(),
+                         term.string_value.begin(), term.string_value.end(),
+                         CaseInsensitiveEquals) != value.end() ||
+          term.string_value.empty();
+
+    case REGEXP_IS:
+      return term.regexp->FullMatch(value);
+
+    case REGEXP_CONTAINS:
+      return term.regexp->PartialMatch(value);
+
+    default:
+      NOTREACHED() << "Invalid filter term.";
+      return false;
+  }
+}
@@ -0,0 +1,141 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Compiled filter program declaration.
+#ifndef SAWBUCK_VIEWER_FILTER_PROGRAM_H_
+#define SAWBUCK_VIEWER_FILTER_PROGRAM_H_
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/memory/scoped_vector.h"
+#include "sawbuck/viewer/column_index.h"
+#include "sawbuck/viewer/filter.h"
+#include "pcrecpp.h"  // NOLINT
+
+// Evaluates a list of filters on the rows of a log view, the way
+// FilteredLogView applies them: a row is included if it matches one of the
+// inclusion filters, or if there are none, and if it matches none of the
+// exclusion filters.
+//
+// The filters are compiled once: integer values are parsed up front, the
+// regular expressions are built once, and patterns without any regular
+// expression syntax are matched as plain strings. When evaluating a row, the
+// integer columns are tested first, as they're the cheapest, and each column
+// is fetched from the log view at most once. The terms on the severity,
+// process id and thread id columns may also be answered by an index of these
+// columns, to skip the rows they exclude without visiting them.
+//
+// Evaluating a compiled program doesn't change it, so a program may be
+// evaluated on several threads at once.
+class FilterProgram {
+ public:
+  FilterProgram();
+  ~FilterProgram();
+
+  // Compiles @p filters, replacing the current program.
+  void Compile(const std::vector<Filter>& filters);
+
+  // @returns true if the row @p row of @p log_view is included by the
+  //     filters.
+  bool Matches(ILogView* log_view, int row) const;
+
+  // Narrows the rows [@p start, @p end) of a log view down to those the
+  // filters may include, using an index of its columns. Only the candidate
+  // rows then need to be evaluated with Matches.
+  // @param index the index of the columns of the log view.
+  // @param start the first row to consider.
+  // @param end the row past the last row to consider.
+  // @param rows receives the candidate rows.
+  // @returns false if none of the filters can be answered by the index, in
+  //     which case all the rows are candidates.
+  bool GetCandidateRows(ILogViewIndex* index,
+                        int start,
+                        int end,
+                        RowBitmap* rows) const;
+
+ private:
+  // How a term matches the value of its column.
+  enum Method {
+    // Compares an integer column to an integer.
+    INT_IS,
+    // Looks for a string in the decimal representation of an integer column.
+    INT_CONTAINS,
+    // Compares a string column to a string, ignoring the case.
+    LITERAL_IS,
+    // Looks for a string in a string column, ignoring the case.
+    LITERAL_CONTAINS,
+    // Runs a regular expression on a string column.
+    REGEXP_IS,
+    REGEXP_CONTAINS
+  };
+
+  // A single compiled filter.
+  struct Term {
+    Filter::Column column;
+    Method method;
+    // The value for INT_IS.
+    int int_value;
+    // The value for INT_CONTAINS, and the lower-case value for the literal
+    // methods.
+    std::string string_value;
+    // The regular expression for the regexp methods. Owned by regexps_.
+    const pcrecpp::RE* regexp;
+    // True if the index of the columns can tell the rows the term matches:
+    // those whose |index_column| holds one of |index_values|.
+    bool indexed;
+    ColumnIndex::Column index_column;
+    std::vector<int> index_values;
+  };
+  typedef std::vector<Term> Terms;
+
+  // The values of a row, fetched on demand.
+  class RowValues;
+
+  // Compiles @p filter and adds it to @p terms.
+  void AddTerm(const Filter& filter, Terms* terms);
+
+  // Sets @p term up to be answered by the index of the columns, if its
+  // column is indexed.
+  static void IndexTerm(Term* term);
+
+  // Gets the rows among [@p start, @p end) that the indexed @p term matches.
+  // @returns false if @p index doesn't cover these rows.
+  static bool GetTermRows(ILogViewIndex* index,
+                          const Term& term,
+                          int start,
+                          int end,
+                          RowBitmap* rows);
+
+  // @returns true if the row matches any of @p terms.
+  static bool MatchesAny(const Terms& terms, RowValues* row);
+
+  // @returns true if @p term matches the row.
+  static bool MatchesTerm(const Term& term, RowValues* row);
+
+  // @returns true if the string @p term matches @p value.
+  static bool MatchesText(const Term& term, const std::string& value);
+
+  // The inclusion and exclusion terms, the integer ones first.
+  Terms inclusions_;
+  Terms exclusions_;
+
+  // The regular expressions of the terms.
+  ScopedVector<pcrecpp::RE> regexps_;
+
+  DISALLOW_COPY_AND_ASSIGN(FilterProgram);
+};
+
+#endif  // SAWBUCK_VIEWER_FILTER_PROGRAM_H_
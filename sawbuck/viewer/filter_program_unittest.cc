@@ -0,0 +1,256 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Compiled filter program unit tests.
+#include "sawbuck/viewer/filter_program.h"
+
+#include <wmistr.h>
+#include <evntrace.h>
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+#include "sawbuck/viewer/mock_log_view_interfaces.h"
+
+namespace {
+
+using testing::_;
+using testing::Return;
+using testing::StrictMock;
+
+const char* kMessages[] = {
+  "I'm not included",
+  "I'm Included",
+  "I'm Included but also Excluded",
+  "Some (parenthesized) text.",
+};
+const DWORD kProcessIds[] = { 42, 11, 999, 4242 };
+const char* kFileNames[] = { "a.cc", "b.cc", "A.CC", "dir/a.cc" };
+const UCHAR kSeverities[] = {
+  TRACE_LEVEL_ERROR, TRACE_LEVEL_INFORMATION, TRACE_LEVEL_ERROR,
+  TRACE_LEVEL_VERBOSE,
+};
+const int kNumRows = arraysize(kMessages);
+
+// An index of the columns of the rows of the fixture.
+class TestLogViewIndex : public ILogViewIndex {
+ public:
+  TestLogViewIndex() {
+    for (int i = 0; i < kNumRows; ++i)
+      index_.AddRow(i, kSeverities[i], kProcessIds[i], 0);
+  }
+
+  virtual bool GetCandidateRows(const std::string& literal,
+                                std::vector<int>* rows) {
+    return false;
+  }
+
+  virtual bool GetColumnRows(ColumnIndex::Column column,
+                             const std::vector<int>& values,
+                             int start,
+                             int end,
+                             RowBitmap* rows) {
+    index_.GetRows(column, values, start, end, rows);
+    return true;
+  }
+
+ private:
+  ColumnIndex index_;
+};
+
+class FilterProgramTest : public testing::Test {
+ public:
+  virtual void SetUp() {
+    for (int i = 0; i < kNumRows; ++i) {
+      EXPECT_CALL(mock_view_, GetMessage(i))
+          .WillRepeatedly(Return(kMessages[i]));
+      EXPECT_CALL(mock_view_, GetProcessId(i))
+          .WillRepeatedly(Return(kProcessIds[i]));
+      EXPECT_CALL(mock_view_, GetFileName(i))
+          .WillRepeatedly(Return(kFileNames[i]));
+      EXPECT_CALL(mock_view_, GetSeverity(i))
+          .WillRepeatedly(Return(kSeverities[i]));
+    }
+  }
+
+  // Checks that the program compiled from @p filters includes the same rows
+  // as the filters themselves.
+  void ExpectSameAsFilters(const std::vector<Filter>& filters) {
+    FilterProgram program;
+    program.Compile(filters);
+
+    for (int i = 0; i < kNumRows; ++i) {
+      bool included = false;
+      bool has_inclusions = false;
+      bool excluded = false;
+      for (size_t j = 0; j < filters.size(); ++j) {
+        bool matches = filters[j].Matches(&mock_view_, i);
+        if (filters[j].action() == Filter::INCLUDE) {
+          has_inclusions = true;
+          included = included || matches;
+        } else {
+          excluded = excluded || matches;
+        }
+      }
+      bool expected = (included || !has_inclusions) && !excluded;
+      EXPECT_EQ(expected, program.Matches(&mock_view_, i)) << "Row " << i;
+    }
+  }
+
+ protected:
+  StrictMock<testing::MockILogView> mock_view_;
+};
+
+}  // namespace
+
+TEST_F(FilterProgramTest, EmptyProgramIncludesEverything) {
+  FilterProgram program;
+  program.Compile(std::vector<Filter>());
+  for (int i = 0; i < kNumRows; ++i)
+    EXPECT_TRUE(program.Matches(&mock_view_, i));
+}
+
+TEST_F(FilterProgramTest, LiteralFilters) {
+  const Filter::Relation kRelations[] = { Filter::IS, Filter::CONTAINS };
+  const wchar_t* kValues[] = {
+    L"", L"included", L"I'm included", L"I'M INCLUDED BUT ALSO EXCLUDED",
+    L"nothing",
+  };
+
+  for (size_t i = 0; i < arraysize(kRelations); ++i) {
+    for (size_t j = 0; j < arraysize(kValues); ++j) {
+      std::vector<Filter> filters;
+      filters.push_back(Filter(Filter::MESSAGE, kRelations[i],
+                               Filter::INCLUDE, kValues[j]));
+      ExpectSameAsFilters(filters);
+    }
+  }
+}
+
+TEST_F(FilterProgramTest, RegExpFilters) {
+  const Filter::Relation kRelations[] = { Filter::IS, Filter::CONTAINS };
+  const wchar_t* kValues[] = {
+    L"i'm .*", L"^I'm Included$", L"\\(.*\\)", L"a\\.cc$", L"[ab]\\.cc",
+  };
+
+  for (size_t i = 0; i < arraysize(kRelations); ++i) {
+    for (size_t j = 0; j < arraysize(kValues); ++j) {
+      std::vector<Filter> filters;
+      filters.push_back(Filter(Filter::MESSAGE, kRelations[i],
+                               Filter::INCLUDE, kValues[j]));
+      filters.push_back(Filter(Filter::FILE, kRelations[i],
+                               Filter::EXCLUDE, kValues[j]));
+      ExpectSameAsFilters(filters);
+    }
+  }
+}
+
+TEST_F(FilterProgramTest, IntFilters) {
+  std::vector<Filter> filters;
+  filters.push_back(Filter(Filter::PROCESS_ID, Filter::CONTAINS,
+                           Filter::INCLUDE, L"42"));
+  ExpectSameAsFilters(filters);
+
+  filters.push_back(Filter(Filter::PROCESS_ID, Filter::IS,
+                           Filter::EXCLUDE, L"4242"));
+  ExpectSameAsFilters(filters);
+
+  filters.push_back(Filter(Filter::PROCESS_ID, Filter::IS,
+                           Filter::INCLUDE, L"999"));
+  ExpectSameAsFilters(filters);
+}
+
+TEST_F(FilterProgramTest, MixedFilters) {
+  std::vector<Filter> filters;
+  filters.push_back(Filter(Filter::MESSAGE, Filter::CONTAINS,
+                           Filter::INCLUDE, L"i'm incl"));
+  filters.push_back(Filter(Filter::PROCESS_ID, Filter::IS,
+                           Filter::INCLUDE, L"4242"));
+  filters.push_back(Filter(Filter::MESSAGE, Filter::CONTAINS,
+                           Filter::EXCLUDE, L"Excluded"));
+  filters.push_back(Filter(Filter::FILE, Filter::IS,
+                           Filter::EXCLUDE, L"b.cc"));
+  ExpectSameAsFilters(filters);
+
+  FilterProgram program;
+  program.Compile(filters);
+  EXPECT_FALSE(program.Matches(&mock_view_, 0));
+  EXPECT_FALSE(program.Matches(&mock_view_, 1));
+  EXPECT_FALSE(program.Matches(&mock_view_, 2));
+  EXPECT_TRUE(program.Matches(&mock_view_, 3));
+}
+
+TEST_F(FilterProgramTest, SeverityFilters) {
+  const Filter::Relation kRelations[] = { Filter::IS, Filter::CONTAINS };
+  const wchar_t* kValues[] = { L"error", L"VERBOSE", L"in", L"e.*r", L"" };
+
+  for (size_t i = 0; i < arraysize(kRelations); ++i) {
+    for (size_t j = 0; j < arraysize(kValues); ++j) {
+      std::vector<Filter> filters;
+      filters.push_back(Filter(Filter::SEVERITY, kRelations[i],
+                               Filter::INCLUDE, kValues[j]));
+      ExpectSameAsFilters(filters);
+    }
+  }
+}
+
+TEST_F(FilterProgramTest, GetCandidateRows) {
+  TestLogViewIndex index;
+  RowBitmap rows;
+
+  // Nothing to narrow the rows down with.
+  FilterProgram program;
+  std::vector<Filter> filters;
+  filters.push_back(Filter(Filter::MESSAGE, Filter::CONTAINS,
+                           Filter::INCLUDE, L"included"));
+  program.Compile(filters);
+  EXPECT_FALSE(program.GetCandidateRows(&index, 0, kNumRows, &rows));
+
+  // An inclusion that isn't indexed keeps all the rows, but the indexed
+  // exclusions remove theirs.
+  filters.push_back(Filter(Filter::PROCESS_ID, Filter::IS,
+                           Filter::EXCLUDE, L"11"));
+  filters.push_back(Filter(Filter::SEVERITY, Filter::CONTAINS,
+                           Filter::EXCLUDE, L"verb"));
+  program.Compile(filters);
+  ASSERT_TRUE(program.GetCandidateRows(&index, 0, kNumRows, &rows));
+  std::vector<int> candidates;
+  rows.GetRows(&candidates);
+  std::vector<int> expected;
+  expected.push_back(0);
+  expected.push_back(2);
+  EXPECT_EQ(expected, candidates);
+
+  // Indexed inclusions narrow the rows down to theirs.
+  filters.clear();
+  filters.push_back(Filter(Filter::SEVERITY, Filter::IS,
+                           Filter::INCLUDE, L"Error"));
+  filters.push_back(Filter(Filter::PROCESS_ID, Filter::IS,
+                           Filter::INCLUDE, L"4242"));
+  filters.push_back(Filter(Filter::PROCESS_ID, Filter::IS,
+                           Filter::EXCLUDE, L"42"));
+  program.Compile(filters);
+  ASSERT_TRUE(program.GetCandidateRows(&index, 0, kNumRows, &rows));
+  candidates.clear();
+  rows.GetRows(&candidates);
+  expected.clear();
+  expected.push_back(2);
+  expected.push_back(3);
+  EXPECT_EQ(expected, candidates);
+  for (int i = 0; i < kNumRows; ++i)
+    EXPECT_EQ(rows.Contains(i), program.Matches(&mock_view_, i));
+
+  // The candidates are restricted to the range.
+  ASSERT_TRUE(program.GetCandidateRows(&index, 3, kNumRows, &rows));
+  EXPECT_EQ(1U, rows.size());
+  EXPECT_TRUE(rows.Contains(3));
+}
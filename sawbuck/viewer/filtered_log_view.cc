@@ -17,12 +17,35 @@
 
 #include "base/bind.h"
 #include "base/logging.h"
+#include "base/memory/scoped_vector.h"
+#include "base/threading/simple_thread.h"
 #include "pcrecpp.h"  // NOLINT
 
+namespace {
+
+// The number of rows filtered per thread in each chunk.
+const int kMaxFilterRows = 1000;
+
+// A delegate that runs a closure, for use with a thread pool.
+class ClosureDelegate : public base::DelegateSimpleThread::Delegate {
+ public:
+  explicit ClosureDelegate(const base::Closure& closure) : closure_(closure) {
+  }
+
+  virtual void Run() OVERRIDE {
+    closure_.Run();
+  }
+
+ private:
+  base::Closure closure_;
+};
+
+}  // namespace
+
 FilteredLogView::FilteredLogView(ILogView* original,
                                  const std::vector<Filter>& filters) :
-    filtered_rows_(0), original_(original),
-    registration_cookie_(0), next_sink_cookie_(1) {
+    filtered_rows_(0), filter_threads_(1), log_view_index_(NULL),
+    original_(original), registration_cookie_(0), next_sink_cookie_(1) {
   DCHECK(original_ != NULL);
   original_->Register(this, &registration_cookie_);
   SetFilters(filters);
@@ -115,15 +138,18 @@ void FilteredLogView::Unregister(int registration_cookie) {
   event_sinks_.erase(registration_cookie);
 }
 
-bool FilteredLogView::MatchesFilterList(const std::vector<Filter>& list,
-                                        int index) {
-  std::vector<Filter>::const_iterator iter(list.begin());
-  for (; iter != list.end(); ++iter) {
-    if (iter->Matches(original_, index)) {
-      return true;
-    }
+void FilteredLogView::FilterRows(const std::vector<int>* candidates,
+                                 size_t begin,
+                                 size_t end,
+                                 std::vector<int>* rows) {
+  DCHECK(candidates != NULL);
+  DCHECK(rows != NULL);
+
+  for (size_t i = begin; i < end; ++i) {
+    int row = (*candidates)[i];
+    if (program_.Matches(original_, row))
+      rows->push_back(row);
   }
-  return false;
 }
 
 void FilteredLogView::FilterChunk() {
@@ -133,28 +159,52 @@ void FilteredLogView::FilterChunk() {
   int starting_rows = GetNumRows();
 
   // Figure the range we're going to filter.
-  const int kMaxFilterRows = 1000;
+  int threads = static_cast<int>(filter_threads_);
   int start = filtered_rows_;
-  int end = std::min(filtered_rows_ + kMaxFilterRows, original_->GetNumRows());
-
+  int end = std::min(filtered_rows_ + kMaxFilterRows * threads,
+                     original_->GetNumRows());
+
+  // Only visit the rows that the index can't rule out.
+  std::vector<int> candidates;
+  RowBitmap candidate_rows;
+  if (log_view_index_ != NULL &&
+      program_.GetCandidateRows(log_view_index_, start, end,
+                                &candidate_rows)) {
+    candidate_rows.GetRows(&candidates);
+  } else {
+    candidates.reserve(end - start);
+    for (int i = start; i < end; ++i)
+      candidates.push_back(i);
+  }
 
-  if (inclusion_filters_.empty()) {
-    // If the inclusion_filters_ list is empty, show all rows that do not match
-    // a filter in the exclusion list
-    for (int i = start; i < end; ++i) {
-      // Run the exclusion filters here..
-      if (!MatchesFilterList(exclusion_filters_, i)) {
-        included_rows_.push_back(i);
-      }
-    }
+  size_t num_candidates = candidates.size();
+  if (threads == 1 ||
+      num_candidates <= static_cast<size_t>(kMaxFilterRows)) {
+    FilterRows(&candidates, 0, num_candidates, &included_rows_);
   } else {
-    // Otherwise, show all rows that match a filter in the inclusion list but
-    // match no rows in the exclusion list.
-    for (int i = start; i < end; ++i) {
-      if (MatchesFilterList(inclusion_filters_, i) &&
-          !MatchesFilterList(exclusion_filters_, i)) {
-        included_rows_.push_back(i);
-      }
+    // Filter blocks of the chunk in parallel. The blocks are contiguous and
+    // in order, so their results are merged by concatenating them.
+    size_t block_size = (num_candidates + threads - 1) / threads;
+    std::vector<std::vector<int> > block_rows(threads);
+    ScopedVector<ClosureDelegate> delegates;
+    base::DelegateSimpleThreadPool pool("FilteredLogView", threads);
+    pool.Start();
+    for (int i = 0; i < threads; ++i) {
+      size_t block_start = i * block_size;
+      size_t block_end = std::min(block_start + block_size, num_candidates);
+      if (block_start >= block_end)
+        break;
+      delegates.push_back(new ClosureDelegate(
+          base::Bind(&FilteredLogView::FilterRows, base::Unretained(this),
+                     &candidates, block_start, block_end, &block_rows[i])));
+      pool.AddWork(delegates.back());
+    }
+    pool.JoinAll();
+
+    for (int i = 0; i < threads; ++i) {
+      included_rows_.insert(included_rows_.end(),
+                            block_rows[i].begin(),
+                            block_rows[i].end());
     }
   }
 
@@ -174,20 +224,7 @@ void FilteredLogView::FilterChunk() {
 }
 
 void FilteredLogView::SetFilters(const std::vector<Filter>& filters) {
-  inclusion_filters_.clear();
-  exclusion_filters_.clear();
-
-  std::vector<Filter>::const_iterator iter(filters.begin());
-  for (; iter != filters.end(); ++iter) {
-    if (iter->action() == Filter::INCLUDE) {
-      inclusion_filters_.push_back(*iter);
-    } else if (iter->action() == Filter::EXCLUDE) {
-      exclusion_filters_.push_back(*iter);
-    } else {
-      NOTREACHED();
-    }
-  }
-
+  program_.Compile(filters);
   RestartFiltering();
 }
 
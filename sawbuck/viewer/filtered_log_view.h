@@ -21,8 +21,10 @@
 #include <vector>
 
 #include "base/cancelable_callback.h"
+#include "base/logging.h"
 #include "base/memory/scoped_ptr.h"
 #include "sawbuck/viewer/filter.h"
+#include "sawbuck/viewer/filter_program.h"
 #include "sawbuck/viewer/log_list_view.h"
 
 // Provides a filtered view on a log.
@@ -57,24 +59,48 @@ class FilteredLogView
 
  void SetFilters(const std::vector<Filter>& filters);
 
+  // Sets the number of threads each chunk of rows is filtered on. With more
+  // than one thread, the chunks are proportionally larger and split in
+  // blocks that are filtered in parallel, while the UI thread waits. The
+  // original view must then support concurrent reads of its rows.
+  void set_filter_threads(size_t filter_threads) {
+    DCHECK_LT(0U, filter_threads);
+    filter_threads_ = filter_threads;
+  }
+  size_t filter_threads() const { return filter_threads_; }
+
+  // Sets an index over the columns of the original view, which lets the
+  // filters on the indexed columns skip the rows they exclude without
+  // visiting them. The index must outlive this view.
+  void set_log_view_index(ILogViewIndex* log_view_index) {
+    log_view_index_ = log_view_index;
+  }
+  ILogViewIndex* log_view_index() const { return log_view_index_; }
+
  protected:
   void PostFilteringTask();
   void FilterChunk();
   virtual void RestartFiltering();
 
-  // Returns true if the item at |index| would match a filter in |list|,
-  // false otherwise.
-  bool MatchesFilterList(const std::vector<Filter>& list, int index);
+  // Runs the inclusion and exclusion filters on the rows of the original view
+  // listed in |candidates|[|begin|, |end|), and appends the included rows to
+  // |rows|, in order.
+  void FilterRows(const std::vector<int>* candidates,
+                  size_t begin,
+                  size_t end,
+                  std::vector<int>* rows);
 
-  // The filters we are using. We break them into two lists, one that contains
-  // inclusion filters, the other exclusion filters.
-  std::vector<Filter> inclusion_filters_;
-  std::vector<Filter> exclusion_filters_;
+  // The filters we are using, compiled.
+  FilterProgram program_;
 
   // The included rows we have filtered.
   std::vector<int> included_rows_;
   // Row number of last row in |original_| that we've processed.
   int filtered_rows_;
+  // The number of threads each chunk is filtered on.
+  size_t filter_threads_;
+  // The index over the columns of |original_|, if any.
+  ILogViewIndex* log_view_index_;
 
   typedef base::CancelableCallback<void()> FilterCallback;
 
@@ -14,6 +14,7 @@
 #include "sawbuck/viewer/filtered_log_view.h"
 
 #include "base/message_loop.h"
+#include "base/stringprintf.h"
 #include "gtest/gtest.h"
 #include "gmock/gmock.h"
 #include "sawbuck/viewer/mock_log_view_interfaces.h"
@@ -239,4 +240,122 @@ TEST_F(FilteredLogViewTest, ClearAll) {
   ExpectUnregistration();
 }
 
+// A log view whose messages can be read concurrently, unlike those of the
+// mock.
+class FakeLogView : public ILogView {
+ public:
+  explicit FakeLogView(int num_rows) {
+    for (int i = 0; i < num_rows; ++i)
+      messages_.push_back(base::StringPrintf("message %d", i));
+  }
+
+  virtual int GetNumRows() { return messages_.size(); }
+  virtual void ClearAll() { messages_.clear(); }
+  virtual int GetSeverity(int row) { return row % 6; }
+  virtual DWORD GetProcessId(int row) { return row % 5; }
+  virtual DWORD GetThreadId(int row) { return 0; }
+  virtual base::Time GetTime(int row) { return base::Time(); }
+  virtual std::string GetFileName(int row) { return std::string(); }
+  virtual int GetLine(int row) { return 0; }
+  virtual std::string GetMessage(int row) { return messages_[row]; }
+  virtual void GetStackTrace(int row, std::vector<void*>* trace) {
+    trace->clear();
+  }
+  virtual void Register(ILogViewEvents* event_sink,
+                        int* registration_cookie) {
+    *registration_cookie = 1;
+  }
+  virtual void Unregister(int registration_cookie) {
+  }
+
+ private:
+  std::vector<std::string> messages_;
+};
+
+TEST_F(FilteredLogViewTest, ParallelFiltering) {
+  const int kNumRows = 12345;
+  FakeLogView fake_view(kNumRows);
+
+  // Include the rows ending in 7, except those ending in 77.
+  std::vector<Filter> filters;
+  filters.push_back(Filter(Filter::MESSAGE, Filter::CONTAINS,
+                           Filter::INCLUDE, L"7$"));
+  filters.push_back(Filter(Filter::MESSAGE, Filter::CONTAINS,
+                           Filter::EXCLUDE, L"77$"));
+
+  TestingFilteredLogView serial(&fake_view, filters);
+  TestingFilteredLogView parallel(&fake_view, filters);
+  parallel.set_filter_threads(4);
+  message_loop_.RunAllPending();
+
+  ASSERT_EQ(kNumRows / 10 - kNumRows / 100, serial.GetNumRows());
+  ASSERT_EQ(serial.GetNumRows(), parallel.GetNumRows());
+  for (int i = 0; i < serial.GetNumRows(); ++i)
+    EXPECT_EQ(serial.GetMessage(i), parallel.GetMessage(i));
+}
+
+// An index of the columns of a fake log view.
+class FakeLogViewIndex : public ILogViewIndex {
+ public:
+  explicit FakeLogViewIndex(ILogView* log_view) : column_queries_(0) {
+    for (int i = 0; i < log_view->GetNumRows(); ++i) {
+      index_.AddRow(i, log_view->GetSeverity(i), log_view->GetProcessId(i),
+                    log_view->GetThreadId(i));
+    }
+  }
+
+  virtual bool GetCandidateRows(const std::string& literal,
+                                std::vector<int>* rows) {
+    return false;
+  }
+
+  virtual bool GetColumnRows(ColumnIndex::Column column,
+                             const std::vector<int>& values,
+                             int start,
+                             int end,
+                             RowBitmap* rows) {
+    ++column_queries_;
+    index_.GetRows(column, values, start, end, rows);
+    return true;
+  }
+
+  int column_queries() const { return column_queries_; }
+
+ private:
+  ColumnIndex index_;
+  int column_queries_;
+};
+
+TEST_F(FilteredLogViewTest, IndexedFiltering) {
+  const int kNumRows = 12345;
+  FakeLogView fake_view(kNumRows);
+  FakeLogViewIndex index(&fake_view);
+
+  // Include the rows of process 3 and the errors, except those ending in 7.
+  std::vector<Filter> filters;
+  filters.push_back(Filter(Filter::PROCESS_ID, Filter::IS,
+                           Filter::INCLUDE, L"3"));
+  filters.push_back(Filter(Filter::SEVERITY, Filter::IS,
+                           Filter::INCLUDE, L"error"));
+  filters.push_back(Filter(Filter::MESSAGE, Filter::CONTAINS,
+                           Filter::EXCLUDE, L"7$"));
+
+  TestingFilteredLogView unindexed(&fake_view, filters);
+  TestingFilteredLogView indexed(&fake_view, filters);
+  indexed.set_log_view_index(&index);
+  TestingFilteredLogView parallel(&fake_view, filters);
+  parallel.set_log_view_index(&index);
+  parallel.set_filter_threads(4);
+  message_loop_.RunAllPending();
+
+  EXPECT_LT(0, index.column_queries());
+  ASSERT_LT(0, unindexed.GetNumRows());
+  ASSERT_EQ(unindexed.GetNumRows(), indexed.GetNumRows());
+  ASSERT_EQ(unindexed.GetNumRows(), parallel.GetNumRows());
+  for (int i = 0; i < unindexed.GetNumRows(); ++i) {
+    EXPECT_EQ(unindexed.GetMessage(i), indexed.GetMessage(i));
+    EXPECT_EQ(unindexed.GetMessage(i), parallel.GetMessage(i));
+  }
+}
+
 }  // namespace
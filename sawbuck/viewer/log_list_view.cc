@@ -15,10 +15,12 @@
 // Log viewer window implementation.
 #include "sawbuck/viewer/log_list_view.h"
 
+#include <algorithm>
 #include <atlalloc.h>
 #include <atlframe.h>
 #include <wmistr.h>
 #include <evntrace.h>
+#include "base/bind.h"
 #include "base/i18n/time_formatting.h"
 #include "base/logging.h"
 #include "base/string_util.h"
@@ -28,37 +30,12 @@
 #include "sawbuck/log_lib/process_info_service.h"
 #include "sawbuck/viewer/const_config.h"
 #include "sawbuck/viewer/resource.h"
+#include "sawbuck/viewer/row_text_cache.h"
 #include "sawbuck/viewer/stack_trace_list_view.h"
+#include "sawbuck/viewer/trigram_index.h"
 
 namespace {
 
-const char* GetSeverityText(UCHAR severity) {
-  switch (severity)  {
-    case TRACE_LEVEL_NONE:
-      return "NONE";
-    case TRACE_LEVEL_FATAL:
-      return "FATAL";
-    case TRACE_LEVEL_ERROR:
-      return "ERROR";
-    case TRACE_LEVEL_WARNING:
-      return "WARNING";
-    case TRACE_LEVEL_INFORMATION:
-      return "INFORMATION";
-    case TRACE_LEVEL_VERBOSE:
-      return "VERBOSE";
-    case TRACE_LEVEL_RESERVED6:
-      return "RESERVED6";
-    case TRACE_LEVEL_RESERVED7:
-      return "RESERVED7";
-    case TRACE_LEVEL_RESERVED8:
-      return "RESERVED8";
-    case TRACE_LEVEL_RESERVED9:
-      return "RESERVED9";
-  }
-
-  return "UNKNOWN";
-}
-
 // Returns true iff state indicates a selected listview item.
 bool IsSelected(UINT state) {
   return (state & LVIS_SELECTED) == LVIS_SELECTED;
@@ -66,6 +43,31 @@ bool IsSelected(UINT state) {
 
 const int kNoItem = -1;
 
+// The number of rows whose text is cached, which bounds the formatting done
+// per paint, and the number of rows cached ahead of and behind those painted.
+const size_t kRowCacheCapacity = 1024;
+const size_t kRowCachePrefetch = 64;
+
+// The most functions and modules we list in a CPU profile.
+const size_t kMaxProfileEntries = 20;
+
+// Appends the top |samples| to |text|, as percentages of |total_samples|.
+void AppendProfileEntries(
+    const CpuProfileSymbolizer::SymbolSampleList& samples,
+    size_t total_samples,
+    std::wstring* text) {
+  for (size_t i = 0; i < samples.size() && i < kMaxProfileEntries; ++i) {
+    const CpuProfileSymbolizer::SymbolSamples& entry = samples[i];
+    base::StringAppendF(text, L"%5.1f%%  %ls%ls%ls (pid %d)\n",
+                        100.0 * entry.count / total_samples,
+                        entry.module.c_str(),
+                        entry.function.empty() ? L"" : L"!",
+                        entry.function.c_str(),
+                        entry.process_id);
+  }
+}
+
+
 }  // namespace
 
 using base::StringPrintf;
@@ -91,10 +93,37 @@ const wchar_t* LogListView::kColumnWidthValueName =
 LogViewFormatter::LogViewFormatter() {
 }
 
+const char* LogViewFormatter::GetSeverityText(int severity) {
+  switch (static_cast<UCHAR>(severity)) {
+    case TRACE_LEVEL_NONE:
+      return "NONE";
+    case TRACE_LEVEL_FATAL:
+      return "FATAL";
+    case TRACE_LEVEL_ERROR:
+      return "ERROR";
+    case TRACE_LEVEL_WARNING:
+      return "WARNING";
+    case TRACE_LEVEL_INFORMATION:
+      return "INFORMATION";
+    case TRACE_LEVEL_VERBOSE:
+      return "VERBOSE";
+    case TRACE_LEVEL_RESERVED6:
+      return "RESERVED6";
+    case TRACE_LEVEL_RESERVED7:
+      return "RESERVED7";
+    case TRACE_LEVEL_RESERVED8:
+      return "RESERVED8";
+    case TRACE_LEVEL_RESERVED9:
+      return "RESERVED9";
+  }
+
+  return "UNKNOWN";
+}
+
 bool LogViewFormatter::FormatColumn(ILogView* log_view,
                                     int row,
                                     Column col,
-                                    std::string* str) {
+                                    std::string* str) const {
   DCHECK(log_view != NULL);
   DCHECK(str != NULL);
 
@@ -169,9 +198,11 @@ bool LogViewFormatter::FormatColumn(ILogView* log_view,
 }
 
 LogListView::LogListView(CUpdateUIBase* update_ui)
-    : log_view_(NULL), event_cookie_(0),
+    : log_view_(NULL), event_cookie_(0), indexed_log_view_(NULL),
+      log_view_index_(NULL),
       update_ui_(update_ui), stack_trace_view_(NULL),
-      process_info_service_(NULL) {
+      process_info_service_(NULL), cpu_profile_(NULL),
+      row_cache_(new RowTextCache(kRowCacheCapacity, kRowCachePrefetch)) {
   ui_loop_ = MessageLoop::current();
 
   context_menu_bar_.LoadMenu(IDR_LIST_VIEW_CONTEXT_MENU);
@@ -181,6 +212,9 @@ LogListView::LogListView(CUpdateUIBase* update_ui)
                  wrong_number_of_column_info);
 }
 
+LogListView::~LogListView() {
+}
+
 void LogListView::SetLogView(ILogView* log_view) {
   if (log_view_ == log_view)
     return;
@@ -193,6 +227,7 @@ void LogListView::SetLogView(ILogView* log_view) {
 
   // Store the new one.
   log_view_ = log_view;
+  row_cache_->Clear();
 
   // Adjust our size if we've been created already.
   if (IsWindow()) {
@@ -207,6 +242,14 @@ void LogListView::SetLogView(ILogView* log_view) {
     log_view_->Register(this, &event_cookie_);
 }
 
+void LogListView::SetCpuProfile(CpuProfile* cpu_profile,
+                                ISymbolLookupService* symbol_lookup_service) {
+  DCHECK(cpu_profile != NULL && symbol_lookup_service != NULL);
+  cpu_profile_ = cpu_profile;
+  cpu_profile_symbolizer_.reset(
+      new CpuProfileSymbolizer(symbol_lookup_service));
+}
+
 LRESULT LogListView::OnCreate(UINT msg,
                               WPARAM wparam,
                               LPARAM lparam,
@@ -260,20 +303,37 @@ LRESULT LogListView::OnGetDispInfo(NMHDR* pnmh) {
 
   if (col == COL_SEVERITY && info->item.mask & LVIF_IMAGE) {
     info->item.iImage =
-        GetImageIndexForSeverity(log_view_->GetSeverity(row));
+        GetImageIndexForSeverity(row_cache_->GetSeverity(log_view_, row));
   }
 
-  std::string temp_text;
-  formatter_.FormatColumn(log_view_,
-                          row,
-                          static_cast<LogViewFormatter::Column>(col),
-                          &temp_text);
+  if (info->item.mask & LVIF_TEXT) {
+    item_text_ = row_cache_->GetText(
+        log_view_, formatter_, row, static_cast<LogViewFormatter::Column>(col));
+    info->item.pszText = const_cast<LPWSTR>(item_text_.c_str());
+  }
 
-  item_text_ = UTF8ToWide(temp_text);
-  TrimWhitespace(item_text_, TRIM_TRAILING, &item_text_);
+  return 0;
+}
 
-  if (info->item.mask & LVIF_TEXT)
-    info->item.pszText = const_cast<LPWSTR>(item_text_.c_str());
+LRESULT LogListView::OnCacheHint(NMHDR* pnmh) {
+  NMLVCACHEHINT* hint = reinterpret_cast<NMLVCACHEHINT*>(pnmh);
+  row_cache_->Prefetch(log_view_, formatter_, hint->iFrom, hint->iTo);
+
+  // Resolve the stack traces of the rows about to be displayed, in case one
+  // gets selected.
+  if (stack_trace_view_ != NULL) {
+    std::vector<void*> trace;
+    for (int row = hint->iFrom; row <= hint->iTo; ++row) {
+      log_view_->GetStackTrace(row, &trace);
+      if (trace.empty())
+        continue;
+
+      stack_trace_view_->PrefetchStackTrace(log_view_->GetProcessId(row),
+                                            log_view_->GetTime(row),
+                                            trace.size(),
+                                            &trace[0]);
+    }
+  }
 
   return 0;
 }
@@ -468,6 +528,14 @@ void LogListView::OnContextMenu(CWindow wnd, CPoint point) {
                   ID_RESET_BASE_TIME,
                   L"&Reset Base Time");
 
+  if (cpu_profile_ != NULL) {
+    bool can_profile = GetSelectedCount() != 0 &&
+        !cpu_profile_symbolizer_->pending();
+    menu.AppendMenu(can_profile ? MF_ENABLED : MF_GRAYED,
+                    ID_CPU_PROFILE,
+                    L"CPU &Profile of Selection");
+  }
+
   // TODO(siggi): Implement popup menu items to include/exclude
   //      the clicked column by its value.
 #if 0
@@ -515,6 +583,18 @@ void LogListView::OnAutoSizeColumns(UINT code, int id, CWindow window) {
     SetColumnWidth(i, LVSCW_AUTOSIZE);
 }
 
+void LogListView::SelectRow(int row) {
+  // Clear the existing selection.
+  int focused = GetNextItem(-1, LVIS_FOCUSED);
+  if (focused >= 0)
+    SetItemState(focused, 0, LVIS_SELECTED | LVIS_FOCUSED);
+
+  // Select and focus the new item.
+  SetItemState(row, LVIS_SELECTED | LVIS_FOCUSED,
+               LVIS_SELECTED | LVIS_FOCUSED);
+  EnsureVisible(row, false);
+}
+
 void LogListView::FindNext() {
   pcrecpp::RE_Options options = PCRE_UTF8;
   options.set_caseless(!find_params_.match_case_);
@@ -527,26 +607,55 @@ void LogListView::FindNext() {
   if (i < 0)
     i = 0;  // in case start == -1.
 
-  for (; down ? i < num_rows : i >= 0; down ? ++i : --i) {
-    std::string message(log_view_->GetMessage(i));
-    if (expression.PartialMatch(message))
-      break;
+  // On large logs, only look at the rows the index can't rule out.
+  std::string literal;
+  std::vector<int> candidates;
+  if (log_view_index_ != NULL && log_view_ == indexed_log_view_ &&
+      TrigramIndex::ExtractLiteral(find_params_.expression_, &literal) &&
+      log_view_index_->GetCandidateRows(literal, &candidates)) {
+    i = FindNextCandidate(expression, candidates, i, num_rows, down);
+  } else {
+    for (; down ? i < num_rows : i >= 0; down ? ++i : --i) {
+      std::string message(log_view_->GetMessage(i));
+      if (expression.PartialMatch(message))
+        break;
+    }
   }
 
   if (i >= 0 && i < num_rows) {
-    // Clear the existing selection.
-    if (start >= 0)
-      SetItemState(start, 0, LVIS_SELECTED | LVIS_FOCUSED);
-
-    // Select and focus the new item.
-    SetItemState(i, LVIS_SELECTED | LVIS_FOCUSED,
-                 LVIS_SELECTED | LVIS_FOCUSED);
-    EnsureVisible(i, false);
+    SelectRow(i);
   } else {
     MessageBox(L"The specified text was not found.");
   }
 }
 
+int LogListView::FindNextCandidate(const pcrecpp::RE& expression,
+                                   const std::vector<int>& candidates,
+                                   int start,
+                                   int num_rows,
+                                   bool down) {
+  // The index may hold rows that have been added since |num_rows| was read.
+  if (down) {
+    std::vector<int>::const_iterator it =
+        std::lower_bound(candidates.begin(), candidates.end(), start);
+    for (; it != candidates.end() && *it < num_rows; ++it) {
+      if (expression.PartialMatch(log_view_->GetMessage(*it)))
+        return *it;
+    }
+  } else {
+    std::vector<int>::const_reverse_iterator it(
+        std::upper_bound(candidates.begin(), candidates.end(), start));
+    for (; it != candidates.rend(); ++it) {
+      if (*it < num_rows &&
+          expression.PartialMatch(log_view_->GetMessage(*it))) {
+        return *it;
+      }
+    }
+  }
+
+  return -1;
+}
+
 void LogListView::OnSetBaseTime(UINT code, int id, CWindow window) {
   // Get the focused item.
   int row = GetNextItem(-1, LVIS_FOCUSED);
@@ -557,6 +666,7 @@ void LogListView::OnSetBaseTime(UINT code, int id, CWindow window) {
 
   // Get the corresponding time.
   formatter_.set_base_time(log_view_->GetTime(row));
+  row_cache_->Clear();
 
   // Refresh the list.
   RedrawItems(0, GetItemCount());
@@ -564,11 +674,61 @@ void LogListView::OnSetBaseTime(UINT code, int id, CWindow window) {
 
 void LogListView::OnResetBaseTime(UINT code, int id, CWindow window) {
   formatter_.set_base_time(base::Time());
+  row_cache_->Clear();
 
   // Refresh the list.
   RedrawItems(0, GetItemCount());
 }
 
+void LogListView::OnCpuProfile(UINT code, int id, CWindow window) {
+  if (cpu_profile_ == NULL || log_view_ == NULL)
+    return;
+
+  // Profile the time range spanned by the selected rows.
+  base::Time start;
+  base::Time end;
+  int item = GetNextItem(kNoItem, LVNI_SELECTED);
+  for (; item != kNoItem; item = GetNextItem(item, LVNI_SELECTED)) {
+    base::Time time = log_view_->GetTime(item);
+    if (start.is_null() || time < start)
+      start = time;
+    if (end.is_null() || time > end)
+      end = time;
+  }
+  if (start.is_null())
+    return;
+
+  CpuProfile::AddressSampleList samples;
+  if (cpu_profile_->GetAddressSamples(
+          start, end + base::TimeDelta::FromMicroseconds(1), &samples) == 0) {
+    ::MessageBox(m_hWnd, L"There are no CPU samples in the selected rows.",
+                 L"CPU Profile", MB_OK);
+    return;
+  }
+
+  cpu_profile_symbolizer_->Symbolize(
+      samples,
+      base::Bind(&LogListView::CpuProfileSymbolized, base::Unretained(this)));
+}
+
+void LogListView::CpuProfileSymbolized(
+    const CpuProfileSymbolizer::SymbolSampleList& functions,
+    const CpuProfileSymbolizer::SymbolSampleList& modules) {
+  size_t total_samples = 0;
+  for (size_t i = 0; i < modules.size(); ++i)
+    total_samples += modules[i].count;
+  if (total_samples == 0 || !IsWindow())
+    return;
+
+  std::wstring text(StringPrintf(L"%u samples.\n\nTop functions:\n",
+                                 static_cast<unsigned int>(total_samples)));
+  AppendProfileEntries(functions, total_samples, &text);
+  text += L"\nTop modules:\n";
+  AppendProfileEntries(modules, total_samples, &text);
+
+  ::MessageBox(m_hWnd, text.c_str(), L"CPU Profile", MB_OK);
+}
+
 void LogListView::LogViewNewItems() {
   DCHECK_EQ(ui_loop_, MessageLoop::current());
 
@@ -588,6 +748,7 @@ void LogListView::LogViewNewItems() {
 
 void LogListView::LogViewCleared() {
   DCHECK_EQ(ui_loop_, MessageLoop::current());
+  row_cache_->Clear();
   DeleteAllItems();
 }
 
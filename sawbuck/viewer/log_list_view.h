@@ -24,10 +24,17 @@
 #include <string>
 #include <vector>
 #include "base/message_loop.h"
+#include "base/memory/scoped_ptr.h"
+#include "sawbuck/log_lib/cpu_profile.h"
+#include "sawbuck/viewer/column_index.h"
 #include "sawbuck/viewer/find_dialog.h"
 #include "sawbuck/viewer/list_view_base.h"
 #include "sawbuck/viewer/resource.h"
 
+namespace pcrecpp {
+class RE;
+}  // namespace pcrecpp
+
 // Callback interface for ILogView.
 class ILogViewEvents {
  public:
@@ -61,6 +68,25 @@ class ILogView {
   virtual void Unregister(int registration_cookie) = 0;
 };
 
+// An index over the messages of a log view, used to speed up searches.
+class ILogViewIndex {
+ public:
+  // Retrieves the rows whose message may contain |literal|, ignoring the
+  // case, in increasing order. Returns false if the index can't narrow the
+  // search down, in which case all rows must be searched.
+  virtual bool GetCandidateRows(const std::string& literal,
+                                std::vector<int>* rows) = 0;
+
+  // Retrieves the rows among [|start|, |end|) whose |column| holds any of
+  // |values|. Returns false if the index doesn't cover these rows, in which
+  // case they must all be visited.
+  virtual bool GetColumnRows(ColumnIndex::Column column,
+                             const std::vector<int>& values,
+                             int start,
+                             int end,
+                             RowBitmap* rows) = 0;
+};
+
 class LogViewFormatter {
  public:
   enum Column {
@@ -81,7 +107,10 @@ class LogViewFormatter {
   bool FormatColumn(ILogView* log_view,
                     int row,
                     Column col,
-                    std::string* str);
+                    std::string* str) const;
+
+  // Returns the text of the severity column for |severity|.
+  static const char* GetSeverityText(int severity);
 
   base::Time base_time() const { return base_time_; }
   void set_base_time(base::Time base_time) { base_time_ = base_time; }
@@ -92,6 +121,7 @@ class LogViewFormatter {
 };
 
 // Forward decls.
+class RowTextCache;
 class StackTraceListView;
 class IProcessInfoService;
 namespace WTL {
@@ -125,13 +155,16 @@ class LogListView
     COMMAND_ID_HANDLER_EX(ID_EDIT_FIND_NEXT, OnFindNext)
     COMMAND_ID_HANDLER_EX(ID_SET_TIME_ZERO, OnSetBaseTime)
     COMMAND_ID_HANDLER_EX(ID_RESET_BASE_TIME, OnResetBaseTime)
+    COMMAND_ID_HANDLER_EX(ID_CPU_PROFILE, OnCpuProfile)
     REFLECTED_NOTIFY_CODE_HANDLER_EX(LVN_GETDISPINFO, OnGetDispInfo)
+    REFLECTED_NOTIFY_CODE_HANDLER_EX(LVN_ODCACHEHINT, OnCacheHint)
     REFLECTED_NOTIFY_CODE_HANDLER_EX(LVN_ITEMCHANGED, OnItemChanged)
     REFLECTED_NOTIFY_CODE_HANDLER_EX(LVN_GETINFOTIP, OnGetInfoTip)
     DEFAULT_REFLECTION_HANDLER()
   END_MSG_MAP()
 
   explicit LogListView(CUpdateUIBase* update_ui);
+  ~LogListView();
 
   void set_stack_trace_view(StackTraceListView* stack_trace_view) {
     stack_trace_view_ = stack_trace_view;
@@ -142,6 +175,23 @@ class LogListView
 
   void SetLogView(ILogView* log_view);
 
+  // Sets the CPU profile of the log and the symbol lookup service to
+  // symbolize it with, which enables profiling the time range of the
+  // selected rows. Both must outlive this object.
+  void SetCpuProfile(CpuProfile* cpu_profile,
+                     ISymbolLookupService* symbol_lookup_service);
+
+  // Sets the index used to speed up searches, which only applies while
+  // |indexed_log_view| is the current log view.
+  void SetLogViewIndex(ILogView* indexed_log_view, ILogViewIndex* index) {
+    indexed_log_view_ = indexed_log_view;
+    log_view_index_ = index;
+  }
+
+  // Selects and focuses |row| instead of the focused row, and scrolls it
+  // into view.
+  void SelectRow(int row);
+
   virtual void LogViewNewItems();
   virtual void LogViewCleared();
 
@@ -172,6 +222,7 @@ class LogListView
   void OnDestroy();
 
   LRESULT OnGetDispInfo(LPNMHDR notification);
+  LRESULT OnCacheHint(LPNMHDR notification);
   LRESULT OnItemChanged(LPNMHDR notification);
   LRESULT OnGetInfoTip(LPNMHDR notification);
 
@@ -188,6 +239,13 @@ class LogListView
   // Context menu command handlers.
   void OnSetBaseTime(UINT code, int id, CWindow window);
   void OnResetBaseTime(UINT code, int id, CWindow window);
+  void OnCpuProfile(UINT code, int id, CWindow window);
+
+  // Displays the top functions and modules of the CPU profile of the
+  // selected rows, once symbolized.
+  void CpuProfileSymbolized(
+      const CpuProfileSymbolizer::SymbolSampleList& functions,
+      const CpuProfileSymbolizer::SymbolSampleList& modules);
 
   // Updates the UI status for commands we support, disables
   // all our commands unless we have focus.
@@ -198,6 +256,15 @@ class LogListView
   // See |find_params_|.
   void FindNext();
 
+  // Finds the next candidate row matching |expression|, from |start| in the
+  // search direction.
+  // @returns the matching row, or -1 if none was found.
+  int FindNextCandidate(const pcrecpp::RE& expression,
+                        const std::vector<int>& candidates,
+                        int start,
+                        int num_rows,
+                        bool down);
+
   // To help unittest mocking.
   virtual BOOL DeleteAllItems() {
     return WindowBase::DeleteAllItems();
@@ -209,9 +276,17 @@ class LogListView
   // Our process info service, if any.
   IProcessInfoService* process_info_service_;
 
+  // The CPU profile of the log, if any, and its symbolizer.
+  CpuProfile* cpu_profile_;
+  scoped_ptr<CpuProfileSymbolizer> cpu_profile_symbolizer_;
+
   ILogView* log_view_;
   int event_cookie_;
 
+  // The index over the messages of |indexed_log_view_|, if any.
+  ILogView* indexed_log_view_;
+  ILogViewIndex* log_view_index_;
+
   // Image indexes for severity, stored by severity value.
   std::vector<int> image_indexes_;
   int GetImageIndexForSeverity(int severity);
@@ -222,6 +297,10 @@ class LogListView
   // Temporary storage for strings returned from OnGetDispInfo.
   std::wstring item_text_;
 
+  // The text of the rows around those displayed, so that painting doesn't
+  // format them again. Cleared when the log view or the formatting changes.
+  scoped_ptr<RowTextCache> row_cache_;
+
   // The last piece of text we searched for.
   FindParameters find_params_;
 
@@ -0,0 +1,209 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Log message store implementation.
+#include "sawbuck/viewer/log_store.h"
+
+#include <algorithm>
+#include "base/logging.h"
+
+namespace {
+
+// Texts larger than this get a block of their own, so as not to waste the
+// end of the current block.
+const size_t kLargeTextSize = LogStore::kTextBlockSize / 4;
+
+}  // namespace
+
+LogStore::LogStore()
+    : size_(0), text_cursor_(NULL), text_remaining_(0), text_size_(0) {
+  segments_.reserve(kMaxSegments);
+}
+
+LogStore::~LogStore() {
+  for (size_t i = 0; i < text_blocks_.size(); ++i)
+    delete [] text_blocks_[i];
+}
+
+bool LogStore::Append(UCHAR level,
+                      DWORD process_id,
+                      DWORD thread_id,
+                      base::Time time_stamp,
+                      const base::StringPiece& file,
+                      int line,
+                      const base::StringPiece& message,
+                      void* const* trace,
+                      size_t trace_depth) {
+  DCHECK(trace != NULL || trace_depth == 0);
+
+  return AppendInterned(level, process_id, thread_id, time_stamp,
+                        InternFile(file), line, message,
+                        InternTrace(trace, trace_depth));
+}
+
+bool LogStore::AppendInterned(UCHAR level,
+                              DWORD process_id,
+                              DWORD thread_id,
+                              base::Time time_stamp,
+                              FileId file,
+                              int line,
+                              const base::StringPiece& message,
+                              TraceId trace) {
+  DCHECK(file != NULL);
+  DCHECK(trace != NULL);
+
+  // Only the writer changes the row count, so it doesn't need to acquire it.
+  size_t row = base::subtle::NoBarrier_Load(&size_);
+  size_t index = row % kSegmentSize;
+  if (index == 0) {
+    if (segments_.size() == kMaxSegments) {
+      LOG(ERROR) << "The log store is full.";
+      return false;
+    }
+    // The directory was reserved, so this doesn't move the segments the
+    // readers are looking at.
+    DCHECK_LT(segments_.size(), segments_.capacity());
+    segments_.push_back(new Segment());
+  }
+
+  Segment* segment = segments_.back();
+  segment->levels[index] = level;
+  segment->process_ids[index] = process_id;
+  segment->thread_ids[index] = thread_id;
+  segment->time_stamps[index] = time_stamp.ToInternalValue();
+  segment->files[index] = file;
+  segment->lines[index] = line;
+  segment->messages[index] = CopyText(message);
+  segment->message_lengths[index] = message.size();
+  segment->traces[index] = trace;
+
+  // Publish the row once it's complete.
+  base::subtle::Release_Store(&size_, row + 1);
+  return true;
+}
+
+void LogStore::Clear() {
+  base::subtle::Release_Store(&size_, 0);
+  segments_.clear();
+
+  for (size_t i = 0; i < text_blocks_.size(); ++i)
+    delete [] text_blocks_[i];
+  text_blocks_.clear();
+  text_cursor_ = NULL;
+  text_remaining_ = 0;
+  text_size_ = 0;
+
+  file_index_.clear();
+  trace_index_.clear();
+  files_.clear();
+  traces_.clear();
+}
+
+UCHAR LogStore::GetLevel(size_t row) const {
+  return GetSegment(row).levels[row % kSegmentSize];
+}
+
+DWORD LogStore::GetProcessId(size_t row) const {
+  return GetSegment(row).process_ids[row % kSegmentSize];
+}
+
+DWORD LogStore::GetThreadId(size_t row) const {
+  return GetSegment(row).thread_ids[row % kSegmentSize];
+}
+
+base::Time LogStore::GetTime(size_t row) const {
+  return base::Time::FromInternalValue(
+      GetSegment(row).time_stamps[row % kSegmentSize]);
+}
+
+const std::string& LogStore::GetFileName(size_t row) const {
+  return *GetSegment(row).files[row % kSegmentSize];
+}
+
+int LogStore::GetLine(size_t row) const {
+  return GetSegment(row).lines[row % kSegmentSize];
+}
+
+base::StringPiece LogStore::GetMessage(size_t row) const {
+  const Segment& segment = GetSegment(row);
+  size_t index = row % kSegmentSize;
+  return base::StringPiece(segment.messages[index],
+                           segment.message_lengths[index]);
+}
+
+void LogStore::GetStackTrace(size_t row, std::vector<void*>* trace) const {
+  DCHECK(trace != NULL);
+  *trace = *GetSegment(row).traces[row % kSegmentSize];
+}
+
+const LogStore::Segment& LogStore::GetSegment(size_t row) const {
+  DCHECK_LT(row, size());
+  return *segments_[row / kSegmentSize];
+}
+
+const char* LogStore::CopyText(const base::StringPiece& text) {
+  if (text.empty())
+    return NULL;
+
+  char* copy = NULL;
+  if (text.size() > kLargeTextSize) {
+    copy = new char[text.size()];
+    // Keep the current block at the back, so that it's still filled.
+    text_blocks_.insert(text_blocks_.end() - (text_cursor_ != NULL ? 1 : 0),
+                        copy);
+    text_size_ += text.size();
+  } else {
+    if (text.size() > text_remaining_) {
+      text_cursor_ = new char[kTextBlockSize];
+      text_remaining_ = kTextBlockSize;
+      text_blocks_.push_back(text_cursor_);
+      text_size_ += kTextBlockSize;
+    }
+    copy = text_cursor_;
+    text_cursor_ += text.size();
+    text_remaining_ -= text.size();
+  }
+
+  ::memcpy(copy, text.data(), text.size());
+  return copy;
+}
+
+LogStore::FileId LogStore::InternFile(const base::StringPiece& file) {
+  FileIndex::const_iterator it(file_index_.find(file));
+  if (it != file_index_.end())
+    return it->second;
+
+  FileId id = &*files_.insert(file.as_string()).first;
+  file_index_.insert(std::make_pair(base::StringPiece(*id), id));
+  return id;
+}
+
+LogStore::TraceId LogStore::InternTrace(void* const* trace,
+                                        size_t trace_depth) {
+  TraceIndex::const_iterator it(
+      trace_index_.find(TraceView(trace, trace_depth)));
+  if (it != trace_index_.end())
+    return it->second;
+
+  TraceId id = &*traces_.insert(Trace(trace, trace + trace_depth)).first;
+  TraceView view(id->empty() ? NULL : &id->front(), id->size());
+  trace_index_.insert(std::make_pair(view, id));
+  return id;
+}
+
+bool LogStore::TraceView::operator<(const TraceView& other) const {
+  return std::lexicographical_compare(frames, frames + depth,
+                                      other.frames,
+                                      other.frames + other.depth);
+}
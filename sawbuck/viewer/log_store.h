@@ -0,0 +1,199 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Log message store declaration.
+#ifndef SAWBUCK_VIEWER_LOG_STORE_H_
+#define SAWBUCK_VIEWER_LOG_STORE_H_
+
+#include <windows.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/basictypes.h"
+#include "base/string_piece.h"
+#include "base/time.h"
+#include "base/memory/scoped_vector.h"
+
+// Stores log messages compactly. The messages are stored column by column in
+// fixed-size segments, so appending never moves the messages already stored.
+// File names and stack traces are interned, as they repeat a lot, and the
+// message texts are packed in large append-only blocks.
+//
+// A single writer at a time may append messages while any number of readers
+// access the rows below size(): the row count is published with release
+// semantics once a row is complete, and read with acquire semantics, so the
+// readers need no lock. Clear must not run concurrently with any other
+// access.
+class LogStore {
+ public:
+  // Interned file names and stack traces, which stay valid until the store
+  // is cleared. Interning must be serialized with Append.
+  typedef const std::string* FileId;
+  typedef const std::vector<void*>* TraceId;
+
+  LogStore();
+  ~LogStore();
+
+  // Appends a message to the store.
+  // @param level the severity of the message.
+  // @param process_id the ID of the process that logged the message.
+  // @param thread_id the ID of the thread that logged the message.
+  // @param time_stamp the time the message was logged.
+  // @param file the file that logged the message, if any.
+  // @param line the line in @p file that logged the message.
+  // @param message the text of the message.
+  // @param trace the stack trace of the message, if any.
+  // @param trace_depth the number of frames in @p trace.
+  // @returns true on success, false if the store is full.
+  bool Append(UCHAR level,
+                DWORD process_id,
+                DWORD thread_id,
+                base::Time time_stamp,
+                const base::StringPiece& file,
+                int line,
+                const base::StringPiece& message,
+                void* const* trace,
+                size_t trace_depth);
+
+  // Appends a message whose file name and stack trace are interned already.
+  // This saves looking them up again for each message when they are known to
+  // repeat, as when loading a saved session.
+  // @param file the interned file that logged the message.
+  // @param trace the interned stack trace of the message.
+  // @returns true on success, false if the store is full.
+  // @note the other parameters are as for Append.
+  bool AppendInterned(UCHAR level,
+                      DWORD process_id,
+                      DWORD thread_id,
+                      base::Time time_stamp,
+                      FileId file,
+                      int line,
+                      const base::StringPiece& message,
+                      TraceId trace);
+
+  // @returns the interned copy of @p file.
+  FileId InternFile(const base::StringPiece& file);
+
+  // @returns the interned copy of a stack trace.
+  TraceId InternTrace(void* const* trace, size_t trace_depth);
+
+  // Removes all the messages, and releases their memory.
+  void Clear();
+
+  // @returns the number of messages in the store.
+  size_t size() const { return base::subtle::Acquire_Load(&size_); }
+
+  // Accessors to the properties of the message at @p row.
+  // @{
+  UCHAR GetLevel(size_t row) const;
+  DWORD GetProcessId(size_t row) const;
+  DWORD GetThreadId(size_t row) const;
+  base::Time GetTime(size_t row) const;
+  const std::string& GetFileName(size_t row) const;
+  int GetLine(size_t row) const;
+  // The returned text is valid until the store is cleared.
+  base::StringPiece GetMessage(size_t row) const;
+  void GetStackTrace(size_t row, std::vector<void*>* trace) const;
+  // @}
+
+  // Writer-side statistics, which must be serialized with Append.
+  // @{
+  // @returns the number of distinct file names.
+  size_t file_count() const { return files_.size(); }
+  // @returns the number of distinct stack traces.
+  size_t trace_count() const { return traces_.size(); }
+  // @returns the size of the blocks holding the message texts, in bytes.
+  size_t text_size() const { return text_size_; }
+  // @}
+
+  // The number of messages in each segment.
+  static const size_t kSegmentSize = 4096;
+
+  // The size of the blocks holding the message texts.
+  static const size_t kTextBlockSize = 1024 * 1024;
+
+  // The maximum number of segments. The segment directory is reserved up
+  // front so that it never moves under the readers.
+  static const size_t kMaxSegments = 64 * 1024;
+
+ private:
+  typedef std::vector<void*> Trace;
+  typedef std::set<std::string> FileSet;
+  typedef std::set<Trace> TraceSet;
+
+  // A stack trace in the caller's buffer, so that looking up an interned
+  // trace doesn't copy it.
+  struct TraceView {
+    TraceView(void* const* frames, size_t depth)
+        : frames(frames), depth(depth) {
+    }
+
+    bool operator<(const TraceView& other) const;
+
+    void* const* frames;
+    size_t depth;
+  };
+
+  // The interned values by their contents, which refer to the interned
+  // copies.
+  typedef std::map<base::StringPiece, FileId> FileIndex;
+  typedef std::map<TraceView, TraceId> TraceIndex;
+
+  // The columns of kSegmentSize messages.
+  struct Segment {
+    UCHAR levels[kSegmentSize];
+    DWORD process_ids[kSegmentSize];
+    DWORD thread_ids[kSegmentSize];
+    int64 time_stamps[kSegmentSize];
+    const std::string* files[kSegmentSize];
+    int lines[kSegmentSize];
+    const char* messages[kSegmentSize];
+    uint32 message_lengths[kSegmentSize];
+    const Trace* traces[kSegmentSize];
+  };
+
+  // @returns the segment holding @p row.
+  const Segment& GetSegment(size_t row) const;
+
+  // @returns a copy of @p text in the text blocks.
+  const char* CopyText(const base::StringPiece& text);
+
+  // The number of complete messages, published to the readers.
+  volatile base::subtle::Atomic32 size_;
+
+  // The messages. The writer adds segments without reallocating.
+  ScopedVector<Segment> segments_;
+
+  // The blocks holding the message texts, and the free space at the end of
+  // the last one.
+  std::vector<char*> text_blocks_;
+  char* text_cursor_;
+  size_t text_remaining_;
+  size_t text_size_;
+
+  // The interned file names and stack traces. The columns point to their
+  // elements, which never move. They are looked up through the indexes, so
+  // that only new values are copied.
+  FileSet files_;
+  TraceSet traces_;
+  FileIndex file_index_;
+  TraceIndex trace_index_;
+
+  DISALLOW_COPY_AND_ASSIGN(LogStore);
+};
+
+#endif  // SAWBUCK_VIEWER_LOG_STORE_H_
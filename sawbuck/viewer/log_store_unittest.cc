@@ -0,0 +1,139 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "sawbuck/viewer/log_store.h"
+
+#include "base/stringprintf.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+void* const kTrace[] = {
+  reinterpret_cast<void*>(0x1000),
+  reinterpret_cast<void*>(0x2000),
+  reinterpret_cast<void*>(0x3000),
+};
+
+TEST(LogStoreTest, AppendAndGet) {
+  LogStore store;
+  EXPECT_EQ(0U, store.size());
+
+  base::Time now = base::Time::Now();
+  EXPECT_TRUE(store.Append(1, 2, 3, now, "file.cc", 42, "message",
+                           kTrace, arraysize(kTrace)));
+  EXPECT_TRUE(store.Append(4, 5, 6, now, "", 0, "", NULL, 0));
+  ASSERT_EQ(2U, store.size());
+
+  EXPECT_EQ(1, store.GetLevel(0));
+  EXPECT_EQ(2U, store.GetProcessId(0));
+  EXPECT_EQ(3U, store.GetThreadId(0));
+  EXPECT_EQ(now, store.GetTime(0));
+  EXPECT_EQ("file.cc", store.GetFileName(0));
+  EXPECT_EQ(42, store.GetLine(0));
+  EXPECT_EQ("message", store.GetMessage(0).as_string());
+  std::vector<void*> trace;
+  store.GetStackTrace(0, &trace);
+  ASSERT_EQ(arraysize(kTrace), trace.size());
+  for (size_t i = 0; i < arraysize(kTrace); ++i)
+    EXPECT_EQ(kTrace[i], trace[i]);
+
+  EXPECT_EQ(4, store.GetLevel(1));
+  EXPECT_EQ("", store.GetFileName(1));
+  EXPECT_TRUE(store.GetMessage(1).empty());
+  store.GetStackTrace(1, &trace);
+  EXPECT_TRUE(trace.empty());
+
+  store.Clear();
+  EXPECT_EQ(0U, store.size());
+  EXPECT_EQ(0U, store.text_size());
+  EXPECT_EQ(0U, store.file_count());
+  EXPECT_EQ(0U, store.trace_count());
+}
+
+TEST(LogStoreTest, InternsFilesAndTraces) {
+  LogStore store;
+  base::Time now = base::Time::Now();
+  for (size_t i = 0; i < 100; ++i) {
+    ASSERT_TRUE(store.Append(1, 2, 3, now, i % 2 ? "a.cc" : "b.cc", i,
+                             "message", kTrace, 1 + i % arraysize(kTrace)));
+  }
+
+  EXPECT_EQ(2U, store.file_count());
+  EXPECT_EQ(arraysize(kTrace), store.trace_count());
+
+  for (size_t i = 0; i < 100; ++i) {
+    EXPECT_EQ(i % 2 ? "a.cc" : "b.cc", store.GetFileName(i));
+    std::vector<void*> trace;
+    store.GetStackTrace(i, &trace);
+    EXPECT_EQ(1 + i % arraysize(kTrace), trace.size());
+  }
+}
+
+TEST(LogStoreTest, InternsFromOtherBuffers) {
+  LogStore store;
+
+  // Values equal to interned ones map to them, wherever they're stored.
+  char file[] = "file.cc";
+  LogStore::FileId file_id = store.InternFile(file);
+  std::string file_copy(file);
+  EXPECT_EQ(file_id, store.InternFile(file_copy));
+  EXPECT_NE(file_id, store.InternFile(base::StringPiece(file, 4)));
+  file[0] = 'F';
+  EXPECT_EQ("file.cc", *file_id);
+  EXPECT_NE(file_id, store.InternFile(file));
+  EXPECT_EQ(3U, store.file_count());
+
+  LogStore::TraceId trace_id = store.InternTrace(kTrace, arraysize(kTrace));
+  std::vector<void*> trace_copy(kTrace, kTrace + arraysize(kTrace));
+  EXPECT_EQ(trace_id, store.InternTrace(&trace_copy[0], trace_copy.size()));
+  EXPECT_NE(trace_id, store.InternTrace(kTrace, 2));
+  LogStore::TraceId empty_id = store.InternTrace(NULL, 0);
+  EXPECT_EQ(empty_id, store.InternTrace(kTrace, 0));
+  EXPECT_EQ(3U, store.trace_count());
+
+  // Clearing the store drops the interned values.
+  store.Clear();
+  EXPECT_EQ(0U, store.file_count());
+  EXPECT_EQ(0U, store.trace_count());
+  store.InternFile(file_copy);
+  store.InternTrace(kTrace, arraysize(kTrace));
+  EXPECT_EQ(1U, store.file_count());
+  EXPECT_EQ(1U, store.trace_count());
+}
+
+TEST(LogStoreTest, ManySegmentsAndLargeMessages) {
+  LogStore store;
+  base::Time now = base::Time::Now();
+  const size_t kCount = 3 * LogStore::kSegmentSize + 1;
+  std::string large(LogStore::kTextBlockSize, 'x');
+
+  for (size_t i = 0; i < kCount; ++i) {
+    std::string message = base::StringPrintf("message %d", static_cast<int>(i));
+    ASSERT_TRUE(store.Append(1, i, i, now, "", 0, message, NULL, 0));
+
+    // A message that's larger than a text block.
+    if (i == LogStore::kSegmentSize)
+      ASSERT_TRUE(store.Append(1, i, i, now, "", 0, large, NULL, 0));
+  }
+  ASSERT_EQ(kCount + 1, store.size());
+
+  // The messages appended before the large message are unaffected by it,
+  // and so are the ones appended after.
+  EXPECT_EQ("message 0", store.GetMessage(0).as_string());
+  EXPECT_EQ(LogStore::kSegmentSize, store.GetProcessId(LogStore::kSegmentSize));
+  EXPECT_EQ(large, store.GetMessage(LogStore::kSegmentSize + 1).as_string());
+  EXPECT_EQ(base::StringPrintf("message %d", static_cast<int>(kCount - 1)),
+            store.GetMessage(kCount).as_string());
+}
+
+}  // namespace
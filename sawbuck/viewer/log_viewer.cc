@@ -17,7 +17,9 @@
 
 #include <atlbase.h>
 #include <atlframe.h>
+#include <algorithm>
 #include "base/string_util.h"
+#include "base/sys_info.h"
 #include "base/utf_string_conversions.h"
 #include "pcrecpp.h"  // NOLINT
 #include "sawbuck/viewer/filtered_log_view.h"
@@ -25,10 +27,27 @@
 #include "sawbuck/viewer/const_config.h"
 #include "sawbuck/viewer/preferences.h"
 
+namespace {
+
+// Creates a view of @p log_view filtered by @p filters, on all processors.
+// The rows of the log view can be read concurrently, and @p index, if not
+// NULL, indexes its columns.
+FilteredLogView* CreateFilteredLogView(ILogView* log_view,
+                                       ILogViewIndex* index,
+                                       const std::vector<Filter>& filters) {
+  FilteredLogView* view = new FilteredLogView(log_view, filters);
+  view->set_filter_threads(base::SysInfo::NumberOfProcessors());
+  view->set_log_view_index(index);
+  return view;
+}
+
+}  // namespace
+
 LogViewer::LogViewer(CUpdateUIBase* update_ui)
     : log_list_view_(update_ui),
       stack_trace_list_view_(update_ui),
       log_view_(NULL),
+      log_view_index_(NULL),
       update_ui_(update_ui) {
 }
 
@@ -41,6 +60,18 @@ void LogViewer::SetLogView(ILogView* log_view) {
   log_list_view_.SetLogView(log_view);
 }
 
+void LogViewer::SetLogViewIndex(ILogViewIndex* index) {
+  DCHECK(log_view_ != NULL);
+  log_view_index_ = index;
+  log_list_view_.SetLogViewIndex(log_view_, index);
+}
+
+ILogView* LogViewer::GetDisplayedLogView() {
+  if (filtered_log_view_ != NULL)
+    return filtered_log_view_.get();
+  return log_view_;
+}
+
 int LogViewer::OnCreate(LPCREATESTRUCT create_struct) {
   DCHECK(log_view_ != NULL) << "SetLogView not called before window creation.";
 
@@ -56,6 +87,11 @@ int LogViewer::OnCreate(LPCREATESTRUCT create_struct) {
   // Create the stack trace list view.
   stack_trace_list_view_.Create(m_hWnd);
 
+  // Create the timeline above the splitter panes.
+  timeline_view_.Create(m_hWnd, rcDefault, NULL,
+                        WS_CHILD | WS_VISIBLE | WS_CLIPSIBLINGS);
+  timeline_view_.set_event_sink(this);
+
   log_list_view_.set_stack_trace_view(&stack_trace_list_view_);
 
   SetDefaultActivePane(SPLIT_PANE_TOP);
@@ -72,17 +108,40 @@ int LogViewer::OnCreate(LPCREATESTRUCT create_struct) {
   if (!filter_string.empty()) {
     std::vector<Filter> filters(Filter::DeserializeFilters(filter_string));
     if (!filters.empty()) {
-      scoped_ptr<FilteredLogView> new_view(new FilteredLogView(log_view_,
-                                                               filters));
+      scoped_ptr<FilteredLogView> new_view(
+          CreateFilteredLogView(log_view_, log_view_index_, filters));
       log_list_view_.SetLogView(new_view.get());
       filtered_log_view_.reset(new_view.release());
     }
   }
+  timeline_view_.SetLogView(GetDisplayedLogView());
 
   SetMsgHandled(FALSE);
   return 1;
 }
 
+void LogViewer::OnSize(UINT type, CSize size) {
+  if (type == SIZE_MINIMIZED)
+    return;
+
+  // The timeline takes the top of the window, and the panes the rest.
+  CRect client;
+  GetClientRect(&client);
+  CRect timeline(client);
+  timeline.bottom = std::min(client.top + kTimelineHeight, client.bottom);
+  timeline_view_.SetWindowPos(NULL, &timeline,
+                              SWP_NOZORDER | SWP_NOACTIVATE);
+
+  CRect panes(client);
+  panes.top = timeline.bottom;
+  SetSplitterRect(&panes);
+}
+
+void LogViewer::TimelineRowSelected(int row) {
+  log_list_view_.SelectRow(row);
+  log_list_view_.SetFocus();
+}
+
 LRESULT LogViewer::OnCommand(UINT msg,
                              WPARAM wparam,
                              LPARAM lparam,
@@ -102,9 +161,10 @@ void LogViewer::OnLogFilter(UINT code, int id, CWindow window) {
 
     // TODO(robertshield): If dialog.get_filters() is empty, we should set it
     // back to the non filtered log view.
-    scoped_ptr<FilteredLogView> new_view(new FilteredLogView(log_view_,
-                                                             filters));
+    scoped_ptr<FilteredLogView> new_view(
+        CreateFilteredLogView(log_view_, log_view_index_, filters));
     log_list_view_.SetLogView(new_view.get());
+    timeline_view_.SetLogView(new_view.get());
     filtered_log_view_.reset(new_view.release());
   }
 }
@@ -26,6 +26,7 @@
 #include "sawbuck/viewer/log_list_view.h"
 #include "sawbuck/viewer/resource.h"
 #include "sawbuck/viewer/stack_trace_list_view.h"
+#include "sawbuck/viewer/timeline_view.h"
 
 // Forward decl.
 namespace WTL {
@@ -35,14 +36,18 @@ class FilteredLogView;
 class IProcessInfoService;
 
 // The log viewer window plays host to a listview, taking care of handling
-// its notification requests etc.
-class LogViewer : public CSplitterWindowImpl<LogViewer, false> {
+// its notification requests etc. A timeline of the message rates sits above
+// the splitter.
+class LogViewer
+    : public CSplitterWindowImpl<LogViewer, false>,
+      public ITimelineViewEvents {
  public:
   typedef CSplitterWindowImpl<LogViewer, false> Super;
 
   static const UINT WM_NEW_MESSAGES = WM_USER + 109;
   BEGIN_MSG_MAP_EX(ViewerWindow)
     MSG_WM_CREATE(OnCreate)
+    MSG_WM_SIZE(OnSize)
     REFLECT_NOTIFICATIONS()
     COMMAND_ID_HANDLER_EX(ID_LOG_FILTER, OnLogFilter)
     COMMAND_ID_HANDLER_EX(ID_INCLUDE_COLUMN, OnIncludeColumn)
@@ -57,15 +62,33 @@ class LogViewer : public CSplitterWindowImpl<LogViewer, false> {
   // This must be called before the log window viewer is created.
   void SetLogView(ILogView* log_view);
 
+  // Sets an index over the messages of the log view, to speed up searches.
+  // This must be called after SetLogView.
+  void SetLogViewIndex(ILogViewIndex* index);
+
+  // Returns the log view displayed, which is filtered if filters are set.
+  ILogView* GetDisplayedLogView();
+
   void SetSymbolLookupService(ISymbolLookupService* symbol_lookup_service) {
     stack_trace_list_view_.SetSymbolLookupService(symbol_lookup_service);
   }
   void SetProcessInfoService(IProcessInfoService* process_info_service) {
     log_list_view_.set_process_info_service(process_info_service);
   }
+  void SetCpuProfile(CpuProfile* cpu_profile,
+                     ISymbolLookupService* symbol_lookup_service) {
+    log_list_view_.SetCpuProfile(cpu_profile, symbol_lookup_service);
+  }
+
+  // ITimelineViewEvents implementation.
+  virtual void TimelineRowSelected(int row);
+
+  // The height of the timeline, in pixels.
+  static const int kTimelineHeight = 64;
 
  private:
   int OnCreate(LPCREATESTRUCT create_struct);
+  void OnSize(UINT type, CSize size);
   LRESULT OnCommand(UINT msg, WPARAM wparam, LPARAM lparam, BOOL& handled);
   void OnLogFilter(UINT code, int id, CWindow window);
   void OnIncludeColumn(UINT code, int id, CWindow window);
@@ -77,9 +100,15 @@ class LogViewer : public CSplitterWindowImpl<LogViewer, false> {
   // The original log view we're handed.
   ILogView* log_view_;
 
+  // The index over the original log view, if any.
+  ILogViewIndex* log_view_index_;
+
   // The list view that displays the log.
   LogListView log_list_view_;
 
+  // The timeline of the message rates of the displayed log.
+  TimelineView timeline_view_;
+
   // The row # of the item currently displayed in the stack trace.
   int stack_trace_item_row_;
 
@@ -60,13 +60,15 @@
 #define ID_EDIT_AUTOSIZE_COLUMNS        4011
 #define ID_INCLUDE_COLUMN               4012
 #define ID_EXCLUDE_COLUMN               4013
+#define ID_FILE_SAVE_SESSION            4014
+#define ID_CPU_PROFILE                  4015
 
 // Next default values for new objects
 //
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        109
-#define _APS_NEXT_COMMAND_VALUE         4013
+#define _APS_NEXT_COMMAND_VALUE         4016
 #define _APS_NEXT_CONTROL_VALUE         1022
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
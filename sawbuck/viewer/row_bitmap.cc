@@ -0,0 +1,346 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Compressed row bitmap implementation.
+#include "sawbuck/viewer/row_bitmap.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "base/logging.h"
+
+namespace {
+
+// The number of rows per container, and of words in a container's bitmap.
+const int kContainerRows = 1 << 16;
+const size_t kBitmapWords = kContainerRows / 32;
+
+uint16 GetKey(int row) {
+  return static_cast<uint16>(row >> 16);
+}
+
+uint16 GetLow(int row) {
+  return static_cast<uint16>(row & 0xFFFF);
+}
+
+// Returns the number of bits set in @p word.
+size_t CountBits(uint32 word) {
+  word = word - ((word >> 1) & 0x55555555);
+  word = (word & 0x33333333) + ((word >> 2) & 0x33333333);
+  return (((word + (word >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+}  // namespace
+
+RowBitmap::Container::Container(uint16 key) : key(key), cardinality(0) {
+}
+
+bool RowBitmap::Container::Contains(uint16 low) const {
+  if (is_bitmap())
+    return (bits[low >> 5] & (1U << (low & 31))) != 0;
+  return std::binary_search(array.begin(), array.end(), low);
+}
+
+void RowBitmap::Container::Add(uint16 low) {
+  if (is_bitmap()) {
+    uint32 bit = 1U << (low & 31);
+    if ((bits[low >> 5] & bit) == 0) {
+      bits[low >> 5] |= bit;
+      ++cardinality;
+    }
+    return;
+  }
+
+  if (array.empty() || array.back() < low) {
+    array.push_back(low);
+  } else {
+    std::vector<uint16>::iterator it =
+        std::lower_bound(array.begin(), array.end(), low);
+    if (*it == low)
+      return;
+    array.insert(it, low);
+  }
+  ++cardinality;
+
+  if (cardinality > kMaxArraySize)
+    ToBitmap();
+}
+
+void RowBitmap::Container::UnionWith(const Container& other) {
+  DCHECK_EQ(key, other.key);
+
+  if (!is_bitmap() && !other.is_bitmap()) {
+    std::vector<uint16> merged;
+    merged.reserve(array.size() + other.array.size());
+    std::set_union(array.begin(), array.end(),
+                   other.array.begin(), other.array.end(),
+                   std::back_inserter(merged));
+    array.swap(merged);
+  } else {
+    ToBitmap();
+    if (other.is_bitmap()) {
+      for (size_t i = 0; i < kBitmapWords; ++i)
+        bits[i] |= other.bits[i];
+    } else {
+      for (size_t i = 0; i < other.array.size(); ++i)
+        bits[other.array[i] >> 5] |= 1U << (other.array[i] & 31);
+    }
+  }
+
+  Normalize();
+}
+
+void RowBitmap::Container::IntersectWith(const Container& other) {
+  DCHECK_EQ(key, other.key);
+
+  if (!is_bitmap()) {
+    // Keep the rows of the array that are in the other container.
+    size_t kept = 0;
+    for (size_t i = 0; i < array.size(); ++i) {
+      if (other.Contains(array[i]))
+        array[kept++] = array[i];
+    }
+    array.resize(kept);
+  } else if (!other.is_bitmap()) {
+    // The result is no larger than the other array.
+    std::vector<uint16> kept;
+    for (size_t i = 0; i < other.array.size(); ++i) {
+      if (Contains(other.array[i]))
+        kept.push_back(other.array[i]);
+    }
+    std::vector<uint32>().swap(bits);
+    array.swap(kept);
+  } else {
+    for (size_t i = 0; i < kBitmapWords; ++i)
+      bits[i] &= other.bits[i];
+  }
+
+  Normalize();
+}
+
+void RowBitmap::Container::SubtractWith(const Container& other) {
+  DCHECK_EQ(key, other.key);
+
+  if (!is_bitmap()) {
+    size_t kept = 0;
+    for (size_t i = 0; i < array.size(); ++i) {
+      if (!other.Contains(array[i]))
+        array[kept++] = array[i];
+    }
+    array.resize(kept);
+  } else if (!other.is_bitmap()) {
+    for (size_t i = 0; i < other.array.size(); ++i)
+      bits[other.array[i] >> 5] &= ~(1U << (other.array[i] & 31));
+  } else {
+    for (size_t i = 0; i < kBitmapWords; ++i)
+      bits[i] &= ~other.bits[i];
+  }
+
+  Normalize();
+}
+
+void RowBitmap::Container::ToBitmap() {
+  if (is_bitmap())
+    return;
+
+  bits.assign(kBitmapWords, 0);
+  for (size_t i = 0; i < array.size(); ++i)
+    bits[array[i] >> 5] |= 1U << (array[i] & 31);
+  std::vector<uint16>().swap(array);
+}
+
+void RowBitmap::Container::Normalize() {
+  if (!is_bitmap()) {
+    cardinality = array.size();
+    if (cardinality > kMaxArraySize)
+      ToBitmap();
+    return;
+  }
+
+  cardinality = 0;
+  for (size_t i = 0; i < kBitmapWords; ++i)
+    cardinality += CountBits(bits[i]);
+  if (cardinality > kMaxArraySize)
+    return;
+
+  // Few enough rows remain to keep them in an array.
+  array.reserve(cardinality);
+  for (size_t i = 0; i < kBitmapWords; ++i) {
+    uint32 word = bits[i];
+    for (size_t bit = 0; word != 0; ++bit, word >>= 1) {
+      if ((word & 1) != 0)
+        array.push_back(static_cast<uint16>(i * 32 + bit));
+    }
+  }
+  std::vector<uint32>().swap(bits);
+}
+
+RowBitmap::RowBitmap() {
+}
+
+RowBitmap::~RowBitmap() {
+}
+
+void RowBitmap::Add(int row) {
+  DCHECK_LE(0, row);
+  GetContainer(GetKey(row))->Add(GetLow(row));
+}
+
+void RowBitmap::AddRange(int start, int end) {
+  DCHECK_LE(0, start);
+  if (start >= end)
+    return;
+
+  for (int key = GetKey(start); key <= GetKey(end - 1); ++key) {
+    int base = key * kContainerRows;
+    int low_start = std::max(start, base) - base;
+    int low_end = std::min(end - base, kContainerRows);
+
+    Container* container = GetContainer(static_cast<uint16>(key));
+    container->ToBitmap();
+    for (int low = low_start; low < low_end; ++low)
+      container->bits[low >> 5] |= 1U << (low & 31);
+    container->Normalize();
+  }
+}
+
+bool RowBitmap::Contains(int row) const {
+  if (row < 0)
+    return false;
+  const Container* container = FindContainer(GetKey(row));
+  return container != NULL && container->Contains(GetLow(row));
+}
+
+void RowBitmap::Union(const RowBitmap& other) {
+  for (size_t i = 0; i < other.containers_.size(); ++i) {
+    const Container& container = other.containers_[i];
+    GetContainer(container.key)->UnionWith(container);
+  }
+}
+
+void RowBitmap::Intersect(const RowBitmap& other) {
+  for (size_t i = 0; i < containers_.size(); ++i) {
+    const Container* container = other.FindContainer(containers_[i].key);
+    if (container == NULL) {
+      containers_[i].array.clear();
+      containers_[i].bits.clear();
+      containers_[i].cardinality = 0;
+    } else {
+      containers_[i].IntersectWith(*container);
+    }
+  }
+  RemoveEmptyContainers();
+}
+
+void RowBitmap::Subtract(const RowBitmap& other) {
+  for (size_t i = 0; i < containers_.size(); ++i) {
+    const Container* container = other.FindContainer(containers_[i].key);
+    if (container != NULL)
+      containers_[i].SubtractWith(*container);
+  }
+  RemoveEmptyContainers();
+}
+
+void RowBitmap::GetRows(std::vector<int>* rows) const {
+  DCHECK(rows != NULL);
+
+  rows->reserve(rows->size() + size());
+  for (size_t i = 0; i < containers_.size(); ++i) {
+    const Container& container = containers_[i];
+    int base = container.key * kContainerRows;
+    if (!container.is_bitmap()) {
+      for (size_t j = 0; j < container.array.size(); ++j)
+        rows->push_back(base + container.array[j]);
+      continue;
+    }
+
+    for (size_t j = 0; j < kBitmapWords; ++j) {
+      uint32 word = container.bits[j];
+      for (int bit = 0; word != 0; ++bit, word >>= 1) {
+        if ((word & 1) != 0)
+          rows->push_back(base + static_cast<int>(j * 32) + bit);
+      }
+    }
+  }
+}
+
+void RowBitmap::Clear() {
+  containers_.clear();
+}
+
+size_t RowBitmap::size() const {
+  size_t size = 0;
+  for (size_t i = 0; i < containers_.size(); ++i)
+    size += containers_[i].cardinality;
+  return size;
+}
+
+size_t RowBitmap::memory_size() const {
+  size_t size = sizeof(*this) + containers_.capacity() * sizeof(Container);
+  for (size_t i = 0; i < containers_.size(); ++i) {
+    size += containers_[i].array.capacity() * sizeof(uint16) +
+        containers_[i].bits.capacity() * sizeof(uint32);
+  }
+  return size;
+}
+
+RowBitmap::Container* RowBitmap::GetContainer(uint16 key) {
+  // The rows are mostly added in increasing order.
+  if (containers_.empty() || containers_.back().key < key) {
+    containers_.push_back(Container(key));
+    return &containers_.back();
+  }
+  if (containers_.back().key == key)
+    return &containers_.back();
+
+  Containers::iterator it = containers_.begin();
+  while (it->key < key)
+    ++it;
+  if (it->key != key)
+    it = containers_.insert(it, Container(key));
+  return &*it;
+}
+
+const RowBitmap::Container* RowBitmap::FindContainer(uint16 key) const {
+  size_t begin = 0;
+  size_t end = containers_.size();
+  while (begin < end) {
+    size_t middle = (begin + end) / 2;
+    if (containers_[middle].key < key)
+      begin = middle + 1;
+    else
+      end = middle;
+  }
+  if (begin == containers_.size() || containers_[begin].key != key)
+    return NULL;
+  return &containers_[begin];
+}
+
+void RowBitmap::RemoveEmptyContainers() {
+  size_t kept = 0;
+  for (size_t i = 0; i < containers_.size(); ++i) {
+    if (containers_[i].cardinality == 0)
+      continue;
+    if (kept != i) {
+      // Move the container down without copying its rows.
+      Container& container = containers_[kept];
+      container.key = containers_[i].key;
+      container.cardinality = containers_[i].cardinality;
+      container.array.swap(containers_[i].array);
+      container.bits.swap(containers_[i].bits);
+    }
+    ++kept;
+  }
+  containers_.resize(kept, Container(0));
+}
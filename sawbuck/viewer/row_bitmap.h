@@ -0,0 +1,130 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Compressed row bitmap declaration.
+#ifndef SAWBUCK_VIEWER_ROW_BITMAP_H_
+#define SAWBUCK_VIEWER_ROW_BITMAP_H_
+
+#include <vector>
+
+#include "base/basictypes.h"
+
+// A compressed set of rows, in the manner of a roaring bitmap: the rows are
+// split in containers of 64K rows sharing their upper 16 bits, and each
+// container holds the lower 16 bits of its rows in a sorted array while there
+// are few of them, and in a plain bitmap otherwise. Sparse and dense sets of
+// rows are thus both compact, and are combined container by container.
+//
+// Sample usage:
+//
+//   RowBitmap errors;
+//   errors.Add(3);
+//   errors.Add(12);
+//   ...
+//   RowBitmap rows;
+//   rows.AddRange(0, 1000);
+//   rows.Intersect(errors);
+//   std::vector<int> row_list;
+//   rows.GetRows(&row_list);
+class RowBitmap {
+ public:
+  RowBitmap();
+  ~RowBitmap();
+
+  // Adds a row to the set. Adding the rows in increasing order is fastest.
+  // @param row the row, which must not be negative.
+  void Add(int row);
+
+  // Adds the rows [@p start, @p end) to the set.
+  void AddRange(int start, int end);
+
+  // @returns true if @p row is in the set.
+  bool Contains(int row) const;
+
+  // Adds the rows of @p other to the set.
+  void Union(const RowBitmap& other);
+
+  // Removes the rows that aren't in @p other from the set.
+  void Intersect(const RowBitmap& other);
+
+  // Removes the rows of @p other from the set.
+  void Subtract(const RowBitmap& other);
+
+  // Appends the rows of the set to @p rows, in increasing order.
+  void GetRows(std::vector<int>* rows) const;
+
+  // Removes all the rows from the set.
+  void Clear();
+
+  // @returns true if the set has no rows.
+  bool empty() const { return containers_.empty(); }
+
+  // @returns the number of rows in the set.
+  size_t size() const;
+
+  // @returns the approximate size of the set, in bytes.
+  size_t memory_size() const;
+
+  // The largest number of rows a container keeps in an array.
+  static const size_t kMaxArraySize = 4096;
+
+ private:
+  // The rows sharing the same upper 16 bits.
+  struct Container {
+    explicit Container(uint16 key);
+
+    bool is_bitmap() const { return !bits.empty(); }
+    bool Contains(uint16 low) const;
+    void Add(uint16 low);
+
+    // Combine the rows of the container with those of @p other.
+    void UnionWith(const Container& other);
+    void IntersectWith(const Container& other);
+    void SubtractWith(const Container& other);
+
+    // Switches to a bitmap, whatever the number of rows.
+    void ToBitmap();
+    // Updates the cardinality and switches to the representation that
+    // suits it.
+    void Normalize();
+
+    // The upper 16 bits of the rows.
+    uint16 key;
+    // The number of rows in the container.
+    size_t cardinality;
+    // The lower 16 bits of the rows, in increasing order, unless the
+    // container is a bitmap.
+    std::vector<uint16> array;
+    // A bit per row of the container, if it's a bitmap.
+    std::vector<uint32> bits;
+  };
+  typedef std::vector<Container> Containers;
+
+  // @returns the container of the rows whose upper 16 bits are @p key,
+  //     which is created if need be.
+  Container* GetContainer(uint16 key);
+
+  // @returns the container of the rows whose upper 16 bits are @p key, or
+  //     NULL if there's none.
+  const Container* FindContainer(uint16 key) const;
+
+  // Drops the empty containers.
+  void RemoveEmptyContainers();
+
+  // The containers of the set, in increasing order of their keys. None of
+  // them is empty.
+  Containers containers_;
+};
+
+#endif  // SAWBUCK_VIEWER_ROW_BITMAP_H_
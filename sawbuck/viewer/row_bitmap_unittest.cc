@@ -0,0 +1,145 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Compressed row bitmap unit tests.
+#include "sawbuck/viewer/row_bitmap.h"
+
+#include "gtest/gtest.h"
+
+namespace {
+
+std::vector<int> GetRows(const RowBitmap& bitmap) {
+  std::vector<int> rows;
+  bitmap.GetRows(&rows);
+  return rows;
+}
+
+TEST(RowBitmapTest, AddAndContains) {
+  RowBitmap bitmap;
+  EXPECT_TRUE(bitmap.empty());
+  EXPECT_EQ(0U, bitmap.size());
+
+  bitmap.Add(3);
+  bitmap.Add(70000);
+  bitmap.Add(1);
+  bitmap.Add(3);
+  EXPECT_FALSE(bitmap.empty());
+  EXPECT_EQ(3U, bitmap.size());
+  EXPECT_LT(0U, bitmap.memory_size());
+
+  EXPECT_TRUE(bitmap.Contains(1));
+  EXPECT_TRUE(bitmap.Contains(3));
+  EXPECT_TRUE(bitmap.Contains(70000));
+  EXPECT_FALSE(bitmap.Contains(2));
+  EXPECT_FALSE(bitmap.Contains(3 + 65536));
+  EXPECT_FALSE(bitmap.Contains(-1));
+
+  std::vector<int> expected;
+  expected.push_back(1);
+  expected.push_back(3);
+  expected.push_back(70000);
+  EXPECT_EQ(expected, GetRows(bitmap));
+
+  bitmap.Clear();
+  EXPECT_TRUE(bitmap.empty());
+  EXPECT_TRUE(GetRows(bitmap).empty());
+}
+
+TEST(RowBitmapTest, DenseContainers) {
+  // Every other row overflows the arrays into bitmaps.
+  RowBitmap even;
+  std::vector<int> expected;
+  for (int i = 0; i < 200000; i += 2) {
+    even.Add(i);
+    expected.push_back(i);
+  }
+  EXPECT_EQ(expected.size(), even.size());
+  EXPECT_EQ(expected, GetRows(even));
+
+  // A bitmap takes 8K per container, far less than the rows would.
+  EXPECT_GT(expected.size() * sizeof(int), even.memory_size());
+}
+
+TEST(RowBitmapTest, AddRange) {
+  RowBitmap bitmap;
+  bitmap.AddRange(10, 10);
+  EXPECT_TRUE(bitmap.empty());
+
+  bitmap.AddRange(65530, 131080);
+  EXPECT_EQ(131080U - 65530U, bitmap.size());
+  EXPECT_FALSE(bitmap.Contains(65529));
+  EXPECT_TRUE(bitmap.Contains(65530));
+  EXPECT_TRUE(bitmap.Contains(100000));
+  EXPECT_TRUE(bitmap.Contains(131079));
+  EXPECT_FALSE(bitmap.Contains(131080));
+
+  std::vector<int> rows = GetRows(bitmap);
+  ASSERT_EQ(bitmap.size(), rows.size());
+  for (size_t i = 0; i < rows.size(); ++i)
+    EXPECT_EQ(static_cast<int>(65530 + i), rows[i]);
+}
+
+TEST(RowBitmapTest, SetOperations) {
+  // Mix sparse and dense containers.
+  RowBitmap threes;
+  RowBitmap fives;
+  for (int i = 0; i < 300000; ++i) {
+    if (i % 3 == 0)
+      threes.Add(i);
+    if (i % 5 == 0 && i < 100000)
+      fives.Add(i);
+  }
+  fives.Add(250000);
+
+  RowBitmap either(threes);
+  either.Union(fives);
+  RowBitmap both(threes);
+  both.Intersect(fives);
+  RowBitmap only_threes(threes);
+  only_threes.Subtract(fives);
+
+  for (int i = 0; i < 300000; ++i) {
+    bool three = i % 3 == 0;
+    bool five = (i % 5 == 0 && i < 100000) || i == 250000;
+    ASSERT_EQ(three || five, either.Contains(i)) << "Row " << i;
+    ASSERT_EQ(three && five, both.Contains(i)) << "Row " << i;
+    ASSERT_EQ(three && !five, only_threes.Contains(i)) << "Row " << i;
+  }
+
+  // The last multiple of 15 among the fives ends the intersection.
+  std::vector<int> rows = GetRows(both);
+  ASSERT_FALSE(rows.empty());
+  EXPECT_EQ(99990, rows.back());
+
+  // Sparse containers combine with sparse and dense ones alike.
+  RowBitmap sparse;
+  sparse.Add(9);
+  sparse.Add(10);
+  sparse.Add(250000);
+  RowBitmap sparse_fives(sparse);
+  sparse_fives.Intersect(fives);
+  EXPECT_EQ(2U, sparse_fives.size());
+  EXPECT_TRUE(sparse_fives.Contains(10));
+  EXPECT_TRUE(sparse_fives.Contains(250000));
+  sparse.Intersect(threes);
+  EXPECT_EQ(std::vector<int>(1, 9), GetRows(sparse));
+
+  // Subtracting everything leaves nothing.
+  only_threes.Subtract(threes);
+  EXPECT_TRUE(only_threes.empty());
+  both.Intersect(RowBitmap());
+  EXPECT_TRUE(both.empty());
+}
+
+}  // namespace
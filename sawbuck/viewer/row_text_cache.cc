@@ -0,0 +1,135 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Row text cache implementation.
+#include "sawbuck/viewer/row_text_cache.h"
+
+#include <algorithm>
+#include "base/logging.h"
+#include "base/string_util.h"
+#include "base/utf_string_conversions.h"
+
+namespace {
+
+// Formats @p column of @p row as displayed, without trailing whitespace.
+void FormatColumnText(ILogView* log_view,
+                      const LogViewFormatter& formatter,
+                      int row,
+                      LogViewFormatter::Column column,
+                      std::wstring* text) {
+  std::string temp_text;
+  formatter.FormatColumn(log_view, row, column, &temp_text);
+
+  *text = UTF8ToWide(temp_text);
+  TrimWhitespace(*text, TRIM_TRAILING, text);
+}
+
+}  // namespace
+
+RowTextCache::RowTextCache(size_t capacity, size_t prefetch_rows)
+    : capacity_(capacity), prefetch_rows_(prefetch_rows), first_row_(0) {
+  DCHECK_LT(0U, capacity);
+}
+
+RowTextCache::~RowTextCache() {
+}
+
+void RowTextCache::Prefetch(ILogView* log_view,
+                            const LogViewFormatter& formatter,
+                            int first_row,
+                            int last_row) {
+  DCHECK(log_view != NULL);
+
+  int num_rows = log_view->GetNumRows();
+  if (first_row > last_row || first_row >= num_rows || last_row < 0)
+    return;
+
+  // Extend the window around the requested rows, within the capacity.
+  int first = std::max(0, first_row - static_cast<int>(prefetch_rows_));
+  int last = std::min(num_rows - 1,
+                      last_row + static_cast<int>(prefetch_rows_));
+  if (static_cast<size_t>(last - first) >= capacity_) {
+    first = std::max(0, first_row);
+    last = std::min(last, first + static_cast<int>(capacity_) - 1);
+  }
+
+  // Drop the rows that leave the window.
+  int end = first_row_ + static_cast<int>(rows_.size());
+  if (rows_.empty() || last < first_row_ || first >= end) {
+    rows_.clear();
+    first_row_ = first;
+  } else {
+    for (; first_row_ < first; ++first_row_)
+      rows_.pop_front();
+    for (; end > last + 1; --end)
+      rows_.pop_back();
+  }
+
+  // Format the rows that come into it.
+  for (; first_row_ > first; --first_row_) {
+    rows_.push_front(Row());
+    FormatRow(log_view, formatter, first_row_ - 1, &rows_.front());
+  }
+  for (int row = first_row_ + rows_.size(); row <= last; ++row) {
+    rows_.push_back(Row());
+    FormatRow(log_view, formatter, row, &rows_.back());
+  }
+
+  DCHECK_LE(rows_.size(), capacity_);
+}
+
+const std::wstring& RowTextCache::GetText(ILogView* log_view,
+                                          const LogViewFormatter& formatter,
+                                          int row,
+                                          LogViewFormatter::Column column) {
+  DCHECK_LE(0, column);
+  DCHECK_GT(LogViewFormatter::NUM_COLUMNS, column);
+
+  if (IsCached(row))
+    return rows_[row - first_row_].text[column];
+
+  FormatColumnText(log_view, formatter, row, column, &uncached_text_);
+  return uncached_text_;
+}
+
+int RowTextCache::GetSeverity(ILogView* log_view, int row) {
+  if (IsCached(row))
+    return rows_[row - first_row_].severity;
+
+  return log_view->GetSeverity(row);
+}
+
+void RowTextCache::Clear() {
+  rows_.clear();
+  first_row_ = 0;
+}
+
+bool RowTextCache::IsCached(int row) const {
+  return row >= first_row_ &&
+      row - first_row_ < static_cast<int>(rows_.size());
+}
+
+void RowTextCache::FormatRow(ILogView* log_view,
+                             const LogViewFormatter& formatter,
+                             int row,
+                             Row* text) {
+  DCHECK(text != NULL);
+
+  text->severity = log_view->GetSeverity(row);
+  for (int column = 0; column < LogViewFormatter::NUM_COLUMNS; ++column) {
+    FormatColumnText(log_view, formatter, row,
+                     static_cast<LogViewFormatter::Column>(column),
+                     &text->text[column]);
+  }
+}
@@ -0,0 +1,93 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Row text cache declaration.
+#ifndef SAWBUCK_VIEWER_ROW_TEXT_CACHE_H_
+#define SAWBUCK_VIEWER_ROW_TEXT_CACHE_H_
+
+#include <deque>
+#include <string>
+
+#include "base/basictypes.h"
+#include "sawbuck/viewer/log_list_view.h"
+
+// Caches the formatted text of a window of consecutive rows of a log view,
+// so that painting the list doesn't format the same rows over and over. The
+// window follows the rows the list asks for, plus a few rows around them:
+// rows that stay in the window are kept as the window slides, and only the
+// rows that come into it are formatted.
+//
+// Rows of a log view don't change once added, so the cache only needs to be
+// cleared when the view changes, or when the formatting does.
+class RowTextCache {
+ public:
+  // @param capacity the maximum number of rows cached.
+  // @param prefetch_rows the number of rows to cache around the requested
+  //     ones, on either side.
+  RowTextCache(size_t capacity, size_t prefetch_rows);
+  ~RowTextCache();
+
+  // Slides the window over the rows from @p first_row to @p last_row,
+  // inclusive, and the rows around them, and formats those not cached yet.
+  // At most capacity() rows are cached, from @p first_row on.
+  void Prefetch(ILogView* log_view,
+                const LogViewFormatter& formatter,
+                int first_row,
+                int last_row);
+
+  // @returns the text of @p column at @p row, formatting it if the row
+  //     isn't cached. The text is valid until the next call.
+  const std::wstring& GetText(ILogView* log_view,
+                              const LogViewFormatter& formatter,
+                              int row,
+                              LogViewFormatter::Column column);
+
+  // @returns the severity of @p row, from the cache if possible.
+  int GetSeverity(ILogView* log_view, int row);
+
+  // Drops all the cached rows.
+  void Clear();
+
+  // @returns true iff @p row is cached.
+  bool IsCached(int row) const;
+
+  size_t capacity() const { return capacity_; }
+  size_t size() const { return rows_.size(); }
+
+ private:
+  struct Row {
+    int severity;
+    std::wstring text[LogViewFormatter::NUM_COLUMNS];
+  };
+
+  // Formats @p row of @p log_view into @p text.
+  static void FormatRow(ILogView* log_view,
+                        const LogViewFormatter& formatter,
+                        int row,
+                        Row* text);
+
+  size_t capacity_;
+  size_t prefetch_rows_;
+
+  // The cached rows, from first_row_ on.
+  std::deque<Row> rows_;
+  int first_row_;
+
+  // Holds the text of rows that aren't cached.
+  std::wstring uncached_text_;
+
+  DISALLOW_COPY_AND_ASSIGN(RowTextCache);
+};
+
+#endif  // SAWBUCK_VIEWER_ROW_TEXT_CACHE_H_
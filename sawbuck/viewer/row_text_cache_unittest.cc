@@ -0,0 +1,157 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "sawbuck/viewer/row_text_cache.h"
+
+#include "base/stringprintf.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+// A log view whose rows are made up, which counts the messages it's asked
+// for.
+class FakeLogView : public ILogView {
+ public:
+  explicit FakeLogView(int num_rows) : num_rows_(num_rows), messages_(0) {
+  }
+
+  virtual int GetNumRows() { return num_rows_; }
+  virtual void ClearAll() {}
+  virtual int GetSeverity(int row) { return row % 5; }
+  virtual DWORD GetProcessId(int row) { return 1; }
+  virtual DWORD GetThreadId(int row) { return 2; }
+  virtual base::Time GetTime(int row) { return base::Time::Now(); }
+  virtual std::string GetFileName(int row) { return "file.cc"; }
+  virtual int GetLine(int row) { return row; }
+  virtual std::string GetMessage(int row) {
+    ++messages_;
+    return base::StringPrintf("message %d  ", row);
+  }
+  virtual void GetStackTrace(int row, std::vector<void*>* trace) {}
+
+  virtual void Register(ILogViewEvents* event_sink,
+                        int* registration_cookie) {}
+  virtual void Unregister(int registration_cookie) {}
+
+  void set_num_rows(int num_rows) { num_rows_ = num_rows; }
+  int messages() const { return messages_; }
+
+ private:
+  int num_rows_;
+  int messages_;
+};
+
+class RowTextCacheTest : public testing::Test {
+ public:
+  RowTextCacheTest() : log_view_(1000), cache_(100, 10) {
+  }
+
+  std::wstring GetMessage(int row) {
+    return cache_.GetText(&log_view_, formatter_, row,
+                          LogViewFormatter::MESSAGE);
+  }
+
+ protected:
+  FakeLogView log_view_;
+  LogViewFormatter formatter_;
+  RowTextCache cache_;
+};
+
+TEST_F(RowTextCacheTest, PrefetchAroundRequestedRows) {
+  cache_.Prefetch(&log_view_, formatter_, 50, 69);
+  EXPECT_EQ(40U, cache_.size());
+  EXPECT_EQ(40, log_view_.messages());
+  EXPECT_FALSE(cache_.IsCached(39));
+  EXPECT_TRUE(cache_.IsCached(40));
+  EXPECT_TRUE(cache_.IsCached(79));
+  EXPECT_FALSE(cache_.IsCached(80));
+
+  // Cached rows are served without going back to the log view, and have
+  // their trailing whitespace trimmed.
+  EXPECT_EQ(L"message 40", GetMessage(40));
+  EXPECT_EQ(L"message 79", GetMessage(79));
+  EXPECT_EQ(L"47", cache_.GetText(&log_view_, formatter_, 47,
+                                  LogViewFormatter::LINE));
+  EXPECT_EQ(2, cache_.GetSeverity(&log_view_, 42));
+  EXPECT_EQ(40, log_view_.messages());
+
+  // Rows out of the window are formatted without being cached.
+  EXPECT_EQ(L"message 500", GetMessage(500));
+  EXPECT_EQ(41, log_view_.messages());
+  EXPECT_FALSE(cache_.IsCached(500));
+  EXPECT_EQ(40U, cache_.size());
+}
+
+TEST_F(RowTextCacheTest, SlidesIncrementally) {
+  cache_.Prefetch(&log_view_, formatter_, 50, 69);
+  ASSERT_EQ(40, log_view_.messages());
+
+  // Scrolling down by five rows only formats the five new rows.
+  cache_.Prefetch(&log_view_, formatter_, 55, 74);
+  EXPECT_EQ(45, log_view_.messages());
+  EXPECT_EQ(40U, cache_.size());
+  EXPECT_FALSE(cache_.IsCached(44));
+  EXPECT_TRUE(cache_.IsCached(84));
+  EXPECT_EQ(L"message 84", GetMessage(84));
+
+  // Same going back up.
+  cache_.Prefetch(&log_view_, formatter_, 52, 71);
+  EXPECT_EQ(48, log_view_.messages());
+  EXPECT_TRUE(cache_.IsCached(42));
+  EXPECT_FALSE(cache_.IsCached(82));
+  EXPECT_EQ(L"message 42", GetMessage(42));
+  EXPECT_EQ(48, log_view_.messages());
+
+  // Jumping elsewhere starts over.
+  cache_.Prefetch(&log_view_, formatter_, 500, 519);
+  EXPECT_EQ(88, log_view_.messages());
+  EXPECT_FALSE(cache_.IsCached(52));
+}
+
+TEST_F(RowTextCacheTest, FollowsNewRows) {
+  // Showing the last rows of the log.
+  cache_.Prefetch(&log_view_, formatter_, 980, 999);
+  EXPECT_EQ(30U, cache_.size());
+  EXPECT_EQ(30, log_view_.messages());
+
+  // New rows come in and the list scrolls to them.
+  log_view_.set_num_rows(1005);
+  cache_.Prefetch(&log_view_, formatter_, 985, 1004);
+  EXPECT_EQ(30U, cache_.size());
+  EXPECT_EQ(35, log_view_.messages());
+  EXPECT_EQ(L"message 1004", GetMessage(1004));
+}
+
+TEST_F(RowTextCacheTest, BoundedByCapacity) {
+  cache_.Prefetch(&log_view_, formatter_, 0, 999);
+  EXPECT_EQ(cache_.capacity(), cache_.size());
+  EXPECT_TRUE(cache_.IsCached(0));
+  EXPECT_TRUE(cache_.IsCached(99));
+  EXPECT_FALSE(cache_.IsCached(100));
+
+  // Requests out of the log are ignored.
+  cache_.Prefetch(&log_view_, formatter_, 1000, 1010);
+  EXPECT_EQ(cache_.capacity(), cache_.size());
+}
+
+TEST_F(RowTextCacheTest, Clear) {
+  cache_.Prefetch(&log_view_, formatter_, 50, 69);
+  cache_.Clear();
+  EXPECT_EQ(0U, cache_.size());
+  EXPECT_FALSE(cache_.IsCached(50));
+
+  cache_.Prefetch(&log_view_, formatter_, 50, 69);
+  EXPECT_EQ(80, log_view_.messages());
+}
+
+}  // namespace
@@ -0,0 +1,484 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Session file implementation.
+//
+// The file starts with a signature, followed by the compressed chunks, the
+// file name table, the stack trace table and the chunk directory. It ends
+// with a trailer that locates the tables and the directory.
+//
+// A decompressed chunk of N messages holds the N time stamps as int64, then
+// the N process IDs, thread IDs, file name indexes, lines, stack trace
+// indexes and message lengths as 32 bit values, then the N levels as bytes,
+// and last the texts of the messages end to end.
+//
+// The file name table holds a count, then each name as its length followed
+// by its characters. The stack trace table holds a count, then each trace as
+// its depth followed by its addresses as 64 bit values. The directory holds
+// a count, then the offset, compressed size, size, message count and the
+// range of time stamps of each chunk.
+#include "sawbuck/viewer/session_file.h"
+
+#include <algorithm>
+#include "base/logging.h"
+#include "sawbuck/viewer/log_list_view.h"
+#include "third_party/zlib/zlib.h"
+
+const wchar_t kSessionFileExtension[] = L".sawbuck";
+
+namespace {
+
+// The file starts with this signature, including its terminating zero.
+const char kSignature[] = "Sawbuck session v1";
+
+// The trailer ends with this value.
+const uint32 kTrailerMagic = 0x53574253;  // 'SBWS'.
+
+// The trailer: the offsets of the tables and of the directory, the number
+// of messages and the magic value.
+const size_t kTrailerSize = 3 * sizeof(uint64) + sizeof(uint64) +
+    sizeof(uint32);
+
+// The size of each message in a chunk, besides its text.
+const size_t kFixedRowSize = sizeof(int64) + 6 * sizeof(uint32) +
+    sizeof(UCHAR);
+
+// A stack trace deeper than this is taken for a corrupt file.
+const uint32 kMaxTraceDepth = 1024;
+
+// Reads values from a range of the mapped file, failing at its end.
+class RangeReader {
+ public:
+  RangeReader(const uint8* data, size_t size) : data_(data), size_(size) {
+  }
+
+  template <typename T>
+  bool Read(T* value) {
+    const uint8* bytes = NULL;
+    if (!Skip(sizeof(*value), &bytes))
+      return false;
+    ::memcpy(value, bytes, sizeof(*value));
+    return true;
+  }
+
+  bool Skip(size_t size, const uint8** bytes) {
+    if (size > size_)
+      return false;
+    *bytes = data_;
+    data_ += size;
+    size_ -= size;
+    return true;
+  }
+
+ private:
+  const uint8* data_;
+  size_t size_;
+};
+
+// Appends the contents of @p column to @p buffer.
+template <typename T>
+void AppendColumn(const std::vector<T>& column, std::string* buffer) {
+  if (!column.empty()) {
+    buffer->append(reinterpret_cast<const char*>(&column[0]),
+                   column.size() * sizeof(T));
+  }
+}
+
+}  // namespace
+
+const int SessionFileWriter::kChunkRows;
+
+struct SessionFileWriter::Chunk {
+  uint64 offset;
+  uint32 compressed_size;
+  uint32 size;
+  uint32 rows;
+  int64 min_time;
+  int64 max_time;
+};
+
+SessionFileWriter::SessionFileWriter(FILE* file)
+    : file_(file), failed_(false), offset_(0) {
+  DCHECK(file != NULL);
+}
+
+SessionFileWriter::~SessionFileWriter() {
+}
+
+bool SessionFileWriter::Write(ILogView* view) {
+  DCHECK(view != NULL);
+
+  Write(kSignature, sizeof(kSignature));
+
+  std::vector<Chunk> chunks;
+  int num_rows = view->GetNumRows();
+  for (int row = 0; row < num_rows && !failed_; row += kChunkRows) {
+    Chunk chunk = {};
+    if (!WriteChunk(view, row, std::min(num_rows - row, kChunkRows), &chunk))
+      return false;
+    chunks.push_back(chunk);
+  }
+
+  // Write the tables in index order.
+  uint64 files_offset = offset_;
+  std::vector<const std::string*> files(files_.size());
+  for (FileMap::const_iterator it = files_.begin(); it != files_.end(); ++it)
+    files[it->second] = &it->first;
+  WriteValue(static_cast<uint32>(files.size()));
+  for (size_t i = 0; i < files.size(); ++i) {
+    WriteValue(static_cast<uint32>(files[i]->size()));
+    Write(files[i]->data(), files[i]->size());
+  }
+
+  uint64 traces_offset = offset_;
+  std::vector<const std::vector<void*>*> traces(traces_.size());
+  for (TraceMap::const_iterator it = traces_.begin(); it != traces_.end();
+       ++it) {
+    traces[it->second] = &it->first;
+  }
+  WriteValue(static_cast<uint32>(traces.size()));
+  for (size_t i = 0; i < traces.size(); ++i) {
+    WriteValue(static_cast<uint32>(traces[i]->size()));
+    for (size_t j = 0; j < traces[i]->size(); ++j)
+      WriteValue(static_cast<uint64>(
+          reinterpret_cast<uintptr_t>(traces[i]->at(j))));
+  }
+
+  uint64 directory_offset = offset_;
+  WriteValue(static_cast<uint32>(chunks.size()));
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    WriteValue(chunks[i].offset);
+    WriteValue(chunks[i].compressed_size);
+    WriteValue(chunks[i].size);
+    WriteValue(chunks[i].rows);
+    WriteValue(chunks[i].min_time);
+    WriteValue(chunks[i].max_time);
+  }
+
+  WriteValue(files_offset);
+  WriteValue(traces_offset);
+  WriteValue(directory_offset);
+  WriteValue(static_cast<uint64>(num_rows));
+  WriteValue(kTrailerMagic);
+
+  if (fflush(file_) != 0)
+    failed_ = true;
+  return !failed_;
+}
+
+bool SessionFileWriter::WriteChunk(ILogView* view,
+                                   int first_row,
+                                   int num_rows,
+                                   Chunk* chunk) {
+  DCHECK(view != NULL);
+  DCHECK_LT(0, num_rows);
+  DCHECK(chunk != NULL);
+
+  std::vector<int64> time_stamps(num_rows);
+  std::vector<uint32> process_ids(num_rows);
+  std::vector<uint32> thread_ids(num_rows);
+  std::vector<uint32> file_indexes(num_rows);
+  std::vector<int32> lines(num_rows);
+  std::vector<uint32> trace_indexes(num_rows);
+  std::vector<uint32> message_lengths(num_rows);
+  std::vector<UCHAR> levels(num_rows);
+  std::string text;
+  std::vector<void*> trace;
+  for (int i = 0; i < num_rows; ++i) {
+    int row = first_row + i;
+    time_stamps[i] = view->GetTime(row).ToInternalValue();
+    process_ids[i] = view->GetProcessId(row);
+    thread_ids[i] = view->GetThreadId(row);
+    file_indexes[i] = InternFile(view->GetFileName(row));
+    lines[i] = view->GetLine(row);
+    view->GetStackTrace(row, &trace);
+    trace_indexes[i] = InternTrace(trace);
+    std::string message(view->GetMessage(row));
+    message_lengths[i] = message.size();
+    levels[i] = view->GetSeverity(row);
+    text.append(message);
+  }
+
+  std::string buffer;
+  buffer.reserve(num_rows * kFixedRowSize + text.size());
+  AppendColumn(time_stamps, &buffer);
+  AppendColumn(process_ids, &buffer);
+  AppendColumn(thread_ids, &buffer);
+  AppendColumn(file_indexes, &buffer);
+  AppendColumn(lines, &buffer);
+  AppendColumn(trace_indexes, &buffer);
+  AppendColumn(message_lengths, &buffer);
+  AppendColumn(levels, &buffer);
+  buffer.append(text);
+
+  uLongf compressed_size = compressBound(buffer.size());
+  std::vector<uint8> compressed(compressed_size);
+  if (compress2(&compressed[0], &compressed_size,
+                reinterpret_cast<const Bytef*>(buffer.data()), buffer.size(),
+                Z_DEFAULT_COMPRESSION) != Z_OK) {
+    LOG(ERROR) << "Failed to compress a session chunk.";
+    return false;
+  }
+
+  chunk->offset = offset_;
+  chunk->compressed_size = compressed_size;
+  chunk->size = buffer.size();
+  chunk->rows = num_rows;
+  chunk->min_time = *std::min_element(time_stamps.begin(), time_stamps.end());
+  chunk->max_time = *std::max_element(time_stamps.begin(), time_stamps.end());
+  Write(&compressed[0], compressed_size);
+
+  return !failed_;
+}
+
+uint32 SessionFileWriter::InternFile(const std::string& file) {
+  return files_.insert(std::make_pair(file, files_.size())).first->second;
+}
+
+uint32 SessionFileWriter::InternTrace(const std::vector<void*>& trace) {
+  return traces_.insert(std::make_pair(trace, traces_.size())).first->second;
+}
+
+void SessionFileWriter::Write(const void* data, size_t size) {
+  if (failed_ || size == 0)
+    return;
+
+  if (fwrite(data, size, 1, file_) != 1) {
+    LOG(ERROR) << "Failed to write to the session file.";
+    failed_ = true;
+    return;
+  }
+  offset_ += size;
+}
+
+SessionChunk::SessionChunk()
+    : size_(0),
+      time_stamps_(NULL),
+      process_ids_(NULL),
+      thread_ids_(NULL),
+      file_indexes_(NULL),
+      lines_(NULL),
+      trace_indexes_(NULL),
+      message_lengths_(NULL),
+      levels_(NULL),
+      text_(NULL) {
+}
+
+SessionChunk::~SessionChunk() {
+}
+
+base::StringPiece SessionChunk::GetMessage(size_t row) const {
+  DCHECK_LT(row, size_);
+  return base::StringPiece(text_ + message_offsets_[row],
+                           message_lengths_[row]);
+}
+
+bool SessionChunk::Init(size_t size, size_t file_count, size_t trace_count) {
+  size_ = 0;
+  if (size == 0 || buffer_.size() < size * kFixedRowSize)
+    return false;
+
+  // The time stamps come first, so that all columns are aligned.
+  const uint8* column = &buffer_[0];
+  time_stamps_ = reinterpret_cast<const int64*>(column);
+  column += size * sizeof(int64);
+  process_ids_ = reinterpret_cast<const DWORD*>(column);
+  column += size * sizeof(DWORD);
+  thread_ids_ = reinterpret_cast<const DWORD*>(column);
+  column += size * sizeof(DWORD);
+  file_indexes_ = reinterpret_cast<const uint32*>(column);
+  column += size * sizeof(uint32);
+  lines_ = reinterpret_cast<const int*>(column);
+  column += size * sizeof(int);
+  trace_indexes_ = reinterpret_cast<const uint32*>(column);
+  column += size * sizeof(uint32);
+  message_lengths_ = reinterpret_cast<const uint32*>(column);
+  column += size * sizeof(uint32);
+  levels_ = reinterpret_cast<const UCHAR*>(column);
+  column += size * sizeof(UCHAR);
+  text_ = reinterpret_cast<const char*>(column);
+
+  size_t text_size = buffer_.size() - size * kFixedRowSize;
+  size_t text_offset = 0;
+  message_offsets_.resize(size);
+  for (size_t i = 0; i < size; ++i) {
+    if (file_indexes_[i] >= file_count || trace_indexes_[i] >= trace_count ||
+        message_lengths_[i] > text_size - text_offset) {
+      return false;
+    }
+    message_offsets_[i] = text_offset;
+    text_offset += message_lengths_[i];
+  }
+  if (text_offset != text_size)
+    return false;
+
+  size_ = size;
+  return true;
+}
+
+SessionFileReader::SessionFileReader() : row_count_(0) {
+}
+
+SessionFileReader::~SessionFileReader() {
+}
+
+bool SessionFileReader::Open(const FilePath& path) {
+  if (!mapped_file_.Initialize(path)) {
+    LOG(ERROR) << "Failed to map " << path.value();
+    return false;
+  }
+
+  if (!ReadIndex()) {
+    LOG(ERROR) << path.value() << " is not a valid session file.";
+    return false;
+  }
+
+  return true;
+}
+
+size_t SessionFileReader::FindChunk(base::Time time) const {
+  int64 time_stamp = time.ToInternalValue();
+  for (size_t i = 0; i < chunks_.size(); ++i) {
+    if (chunks_[i].max_time >= time_stamp)
+      return i;
+  }
+  return chunks_.size();
+}
+
+bool SessionFileReader::ReadChunk(size_t index, SessionChunk* rows) const {
+  DCHECK_LT(index, chunks_.size());
+  DCHECK(rows != NULL);
+
+  const Chunk& chunk = chunks_[index];
+  rows->buffer_.resize(chunk.size);
+  uLongf size = chunk.size;
+  if (chunk.size == 0 ||
+      uncompress(&rows->buffer_[0], &size,
+                 mapped_file_.data() + chunk.offset,
+                 chunk.compressed_size) != Z_OK ||
+      size != chunk.size ||
+      !rows->Init(chunk.rows, files_.size(), traces_.size())) {
+    LOG(ERROR) << "Session chunk " << index << " is corrupt.";
+    return false;
+  }
+
+  return true;
+}
+
+size_t SessionFileReader::AppendChunk(const SessionChunk& rows,
+                                      LogStore* store) const {
+  DCHECK(store != NULL);
+
+  std::map<uint32, LogStore::FileId> files;
+  std::map<uint32, LogStore::TraceId> traces;
+  for (size_t i = 0; i < rows.size(); ++i) {
+    LogStore::FileId& file = files[rows.GetFileIndex(i)];
+    if (file == NULL)
+      file = store->InternFile(files_[rows.GetFileIndex(i)]);
+
+    LogStore::TraceId& trace = traces[rows.GetTraceIndex(i)];
+    if (trace == NULL) {
+      const std::vector<void*>& addresses = traces_[rows.GetTraceIndex(i)];
+      trace = store->InternTrace(addresses.empty() ? NULL : &addresses[0],
+                                 addresses.size());
+    }
+
+    if (!store->AppendInterned(rows.GetLevel(i),
+                               rows.GetProcessId(i),
+                               rows.GetThreadId(i),
+                               rows.GetTime(i),
+                               file,
+                               rows.GetLine(i),
+                               rows.GetMessage(i),
+                               trace)) {
+      return i;
+    }
+  }
+
+  return rows.size();
+}
+
+bool SessionFileReader::ReadIndex() {
+  const uint8* data = mapped_file_.data();
+  size_t length = mapped_file_.length();
+  if (length < sizeof(kSignature) + kTrailerSize ||
+      ::memcmp(data, kSignature, sizeof(kSignature)) != 0) {
+    return false;
+  }
+
+  uint64 files_offset = 0;
+  uint64 traces_offset = 0;
+  uint64 directory_offset = 0;
+  uint32 magic = 0;
+  size_t end = length - kTrailerSize;
+  RangeReader trailer(data + end, kTrailerSize);
+  if (!trailer.Read(&files_offset) || !trailer.Read(&traces_offset) ||
+      !trailer.Read(&directory_offset) || !trailer.Read(&row_count_) ||
+      !trailer.Read(&magic) || magic != kTrailerMagic ||
+      files_offset > traces_offset || traces_offset > directory_offset ||
+      directory_offset > end) {
+    return false;
+  }
+
+  const uint8* bytes = NULL;
+  uint32 count = 0;
+  RangeReader file_table(data + files_offset, traces_offset - files_offset);
+  if (!file_table.Read(&count))
+    return false;
+  files_.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    uint32 size = 0;
+    if (!file_table.Read(&size) || !file_table.Skip(size, &bytes))
+      return false;
+    files_[i].set(reinterpret_cast<const char*>(bytes), size);
+  }
+
+  RangeReader trace_table(data + traces_offset,
+                          directory_offset - traces_offset);
+  if (!trace_table.Read(&count))
+    return false;
+  traces_.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    uint32 depth = 0;
+    if (!trace_table.Read(&depth) || depth > kMaxTraceDepth)
+      return false;
+    traces_[i].resize(depth);
+    for (size_t j = 0; j < depth; ++j) {
+      uint64 address = 0;
+      if (!trace_table.Read(&address))
+        return false;
+      traces_[i][j] = reinterpret_cast<void*>(static_cast<uintptr_t>(address));
+    }
+  }
+
+  RangeReader directory(data + directory_offset, end - directory_offset);
+  if (!directory.Read(&count))
+    return false;
+  chunks_.resize(count);
+  uint64 rows = 0;
+  for (size_t i = 0; i < count; ++i) {
+    Chunk& chunk = chunks_[i];
+    if (!directory.Read(&chunk.offset) ||
+        !directory.Read(&chunk.compressed_size) ||
+        !directory.Read(&chunk.size) || !directory.Read(&chunk.rows) ||
+        !directory.Read(&chunk.min_time) || !directory.Read(&chunk.max_time) ||
+        chunk.offset < sizeof(kSignature) || chunk.offset > files_offset ||
+        chunk.compressed_size > files_offset - chunk.offset) {
+      return false;
+    }
+    rows += chunk.rows;
+  }
+
+  return rows == row_count_;
+}
@@ -0,0 +1,200 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Session file declarations. A session file holds the messages of a log
+// view, in a form the viewer loads much faster than it decodes log files.
+//
+// The messages are stored in chunks of kChunkRows messages, column by column,
+// and each chunk is compressed on its own. File names and stack traces are
+// interned in tables that all chunks refer to. A directory at the end of the
+// file locates the chunks and holds the range of their time stamps, so that
+// readers can seek by time without decompressing anything.
+#ifndef SAWBUCK_VIEWER_SESSION_FILE_H_
+#define SAWBUCK_VIEWER_SESSION_FILE_H_
+
+#include <windows.h>
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/file_path.h"
+#include "base/string_piece.h"
+#include "base/time.h"
+#include "base/files/memory_mapped_file.h"
+#include "sawbuck/viewer/log_store.h"
+
+class ILogView;
+
+// The extension of session files.
+extern const wchar_t kSessionFileExtension[];
+
+// Writes the rows of a log view to a session file.
+class SessionFileWriter {
+ public:
+  // @param file the file to write to, which must outlive the writer.
+  explicit SessionFileWriter(FILE* file);
+  ~SessionFileWriter();
+
+  // Writes the rows of @p view.
+  // @returns true on success, false on a write error.
+  bool Write(ILogView* view);
+
+  // The number of messages in each chunk.
+  static const int kChunkRows = 16 * 1024;
+
+ private:
+  struct Chunk;
+
+  // Writes the @p num_rows rows of @p view from @p first_row as a chunk.
+  bool WriteChunk(ILogView* view, int first_row, int num_rows, Chunk* chunk);
+
+  // @returns the index of @p file in the file name table.
+  uint32 InternFile(const std::string& file);
+
+  // @returns the index of @p trace in the stack trace table.
+  uint32 InternTrace(const std::vector<void*>& trace);
+
+  template <typename T>
+  void WriteValue(const T& value) {
+    Write(&value, sizeof(value));
+  }
+  void Write(const void* data, size_t size);
+
+  FILE* file_;
+  bool failed_;
+
+  // The number of bytes written so far.
+  uint64 offset_;
+
+  // The interned file names and stack traces, and their indexes.
+  typedef std::map<std::string, uint32> FileMap;
+  typedef std::map<std::vector<void*>, uint32> TraceMap;
+  FileMap files_;
+  TraceMap traces_;
+
+  DISALLOW_COPY_AND_ASSIGN(SessionFileWriter);
+};
+
+// A decompressed chunk of a session file.
+class SessionChunk {
+ public:
+  SessionChunk();
+  ~SessionChunk();
+
+  // @returns the number of messages in the chunk.
+  size_t size() const { return size_; }
+
+  // Accessors to the properties of the message at @p row.
+  // @{
+  UCHAR GetLevel(size_t row) const { return levels_[row]; }
+  DWORD GetProcessId(size_t row) const { return process_ids_[row]; }
+  DWORD GetThreadId(size_t row) const { return thread_ids_[row]; }
+  base::Time GetTime(size_t row) const {
+    return base::Time::FromInternalValue(time_stamps_[row]);
+  }
+  int GetLine(size_t row) const { return lines_[row]; }
+  base::StringPiece GetMessage(size_t row) const;
+  // The indexes of the file name and stack trace in the tables of the file.
+  uint32 GetFileIndex(size_t row) const { return file_indexes_[row]; }
+  uint32 GetTraceIndex(size_t row) const { return trace_indexes_[row]; }
+  // @}
+
+ private:
+  friend class SessionFileReader;
+
+  // Points the columns into buffer_, which holds @p size messages.
+  // @returns false if the buffer is too short, or its indexes are out of
+  //     the bounds of the tables.
+  bool Init(size_t size, size_t file_count, size_t trace_count);
+
+  std::vector<uint8> buffer_;
+  size_t size_;
+
+  // The columns, in buffer_.
+  const int64* time_stamps_;
+  const DWORD* process_ids_;
+  const DWORD* thread_ids_;
+  const uint32* file_indexes_;
+  const int* lines_;
+  const uint32* trace_indexes_;
+  const uint32* message_lengths_;
+  const UCHAR* levels_;
+  const char* text_;
+
+  // The offsets of the messages in text_.
+  std::vector<uint32> message_offsets_;
+
+  DISALLOW_COPY_AND_ASSIGN(SessionChunk);
+};
+
+// Reads a session file, which is mapped into memory. The chunks are only
+// decompressed as they are read.
+class SessionFileReader {
+ public:
+  SessionFileReader();
+  ~SessionFileReader();
+
+  // Maps the session file at @p path, and reads its tables and directory.
+  // @returns false if the file can't be mapped or is invalid.
+  bool Open(const FilePath& path);
+
+  // @returns the number of messages in the file.
+  uint64 row_count() const { return row_count_; }
+
+  // @returns the number of chunks in the file.
+  size_t chunk_count() const { return chunks_.size(); }
+
+  // @returns the index of the first chunk holding a message logged at or
+  //     after @p time, or chunk_count() if there is none.
+  size_t FindChunk(base::Time time) const;
+
+  // Decompresses the chunk at @p index into @p rows.
+  // @returns false if the chunk is corrupt.
+  bool ReadChunk(size_t index, SessionChunk* rows) const;
+
+  // Appends the messages of @p rows to @p store, interning the file names
+  // and stack traces they refer to once per chunk. Interning and appending
+  // must be serialized with the other writers of @p store.
+  // @returns the number of messages appended, which is less than the size
+  //     of @p rows if the store fills up.
+  size_t AppendChunk(const SessionChunk& rows, LogStore* store) const;
+
+ private:
+  struct Chunk {
+    uint64 offset;
+    uint32 compressed_size;
+    uint32 size;
+    uint32 rows;
+    int64 min_time;
+    int64 max_time;
+  };
+
+  // Reads the tables and directory of the mapped file.
+  bool ReadIndex();
+
+  base::MemoryMappedFile mapped_file_;
+
+  uint64 row_count_;
+
+  // The file names point into the mapped file.
+  std::vector<base::StringPiece> files_;
+  std::vector<std::vector<void*> > traces_;
+  std::vector<Chunk> chunks_;
+
+  DISALLOW_COPY_AND_ASSIGN(SessionFileReader);
+};
+
+#endif  // SAWBUCK_VIEWER_SESSION_FILE_H_
@@ -0,0 +1,212 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "sawbuck/viewer/session_file.h"
+
+#include "base/file_util.h"
+#include "base/stringprintf.h"
+#include "sawbuck/viewer/log_list_view.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+void* const kTrace[] = {
+  reinterpret_cast<void*>(0x1000),
+  reinterpret_cast<void*>(0x2000),
+  reinterpret_cast<void*>(0x3000),
+};
+
+// A log view over a log store.
+class StoreLogView : public ILogView {
+ public:
+  explicit StoreLogView(const LogStore* store) : store_(store) {
+  }
+
+  virtual int GetNumRows() { return store_->size(); }
+  virtual void ClearAll() {}
+  virtual int GetSeverity(int row) { return store_->GetLevel(row); }
+  virtual DWORD GetProcessId(int row) { return store_->GetProcessId(row); }
+  virtual DWORD GetThreadId(int row) { return store_->GetThreadId(row); }
+  virtual base::Time GetTime(int row) { return store_->GetTime(row); }
+  virtual std::string GetFileName(int row) {
+    return store_->GetFileName(row);
+  }
+  virtual int GetLine(int row) { return store_->GetLine(row); }
+  virtual std::string GetMessage(int row) {
+    return store_->GetMessage(row).as_string();
+  }
+  virtual void GetStackTrace(int row, std::vector<void*>* trace) {
+    store_->GetStackTrace(row, trace);
+  }
+
+  virtual void Register(ILogViewEvents* event_sink,
+                        int* registration_cookie) {}
+  virtual void Unregister(int registration_cookie) {}
+
+ private:
+  const LogStore* store_;
+};
+
+class SessionFileTest : public testing::Test {
+ public:
+  virtual void SetUp() {
+    ASSERT_TRUE(file_util::CreateTemporaryFile(&path_));
+  }
+
+  virtual void TearDown() {
+    file_util::Delete(path_, false);
+  }
+
+  // Fills store_ with @p num_rows messages, one second apart.
+  void FillStore(size_t num_rows) {
+    for (size_t i = 0; i < num_rows; ++i) {
+      std::string message =
+          base::StringPrintf("message %d", static_cast<int>(i));
+      ASSERT_TRUE(store_.Append(i % 5, 100 + i % 3, 200 + i % 7,
+                                base::Time::FromInternalValue(i * 1000000),
+                                i % 2 ? "a.cc" : "b.cc", i, message,
+                                kTrace, i % (arraysize(kTrace) + 1)));
+    }
+  }
+
+  // Writes store_ to the session file.
+  bool WriteSession() {
+    FILE* file = file_util::OpenFile(path_, "wb");
+    if (file == NULL)
+      return false;
+
+    StoreLogView view(&store_);
+    SessionFileWriter writer(file);
+    bool written = writer.Write(&view);
+    file_util::CloseFile(file);
+    return written;
+  }
+
+  // Reads the session file into @p store.
+  bool ReadSession(LogStore* store) {
+    SessionFileReader reader;
+    if (!reader.Open(path_))
+      return false;
+
+    SessionChunk rows;
+    for (size_t i = 0; i < reader.chunk_count(); ++i) {
+      if (!reader.ReadChunk(i, &rows) ||
+          reader.AppendChunk(rows, store) != rows.size()) {
+        return false;
+      }
+    }
+    return store->size() == reader.row_count();
+  }
+
+ protected:
+  FilePath path_;
+  LogStore store_;
+};
+
+TEST_F(SessionFileTest, RoundTrip) {
+  const size_t kNumRows = SessionFileWriter::kChunkRows * 2 + 10;
+  ASSERT_NO_FATAL_FAILURE(FillStore(kNumRows));
+  ASSERT_TRUE(WriteSession());
+
+  LogStore loaded;
+  ASSERT_TRUE(ReadSession(&loaded));
+  ASSERT_EQ(kNumRows, loaded.size());
+  EXPECT_EQ(2U, loaded.file_count());
+  EXPECT_EQ(arraysize(kTrace) + 1, loaded.trace_count());
+
+  for (size_t i = 0; i < kNumRows; ++i) {
+    EXPECT_EQ(store_.GetLevel(i), loaded.GetLevel(i));
+    EXPECT_EQ(store_.GetProcessId(i), loaded.GetProcessId(i));
+    EXPECT_EQ(store_.GetThreadId(i), loaded.GetThreadId(i));
+    EXPECT_EQ(store_.GetTime(i), loaded.GetTime(i));
+    EXPECT_EQ(store_.GetFileName(i), loaded.GetFileName(i));
+    EXPECT_EQ(store_.GetLine(i), loaded.GetLine(i));
+    EXPECT_EQ(store_.GetMessage(i), loaded.GetMessage(i));
+
+    std::vector<void*> expected_trace;
+    std::vector<void*> trace;
+    store_.GetStackTrace(i, &expected_trace);
+    loaded.GetStackTrace(i, &trace);
+    EXPECT_TRUE(expected_trace == trace);
+  }
+}
+
+TEST_F(SessionFileTest, EmptySession) {
+  ASSERT_TRUE(WriteSession());
+
+  SessionFileReader reader;
+  ASSERT_TRUE(reader.Open(path_));
+  EXPECT_EQ(0U, reader.row_count());
+  EXPECT_EQ(0U, reader.chunk_count());
+}
+
+TEST_F(SessionFileTest, FindChunk) {
+  const size_t kNumRows = SessionFileWriter::kChunkRows * 3;
+  ASSERT_NO_FATAL_FAILURE(FillStore(kNumRows));
+  ASSERT_TRUE(WriteSession());
+
+  SessionFileReader reader;
+  ASSERT_TRUE(reader.Open(path_));
+  ASSERT_EQ(3U, reader.chunk_count());
+
+  EXPECT_EQ(0U, reader.FindChunk(base::Time()));
+  EXPECT_EQ(1U, reader.FindChunk(store_.GetTime(
+      SessionFileWriter::kChunkRows)));
+  EXPECT_EQ(1U, reader.FindChunk(store_.GetTime(
+      SessionFileWriter::kChunkRows * 2 - 1)));
+  EXPECT_EQ(2U, reader.FindChunk(store_.GetTime(kNumRows - 1)));
+  EXPECT_EQ(3U, reader.FindChunk(
+      store_.GetTime(kNumRows - 1) + base::TimeDelta::FromSeconds(1)));
+}
+
+TEST_F(SessionFileTest, RejectsCorruptFiles) {
+  ASSERT_NO_FATAL_FAILURE(FillStore(100));
+  ASSERT_TRUE(WriteSession());
+
+  std::string contents;
+  ASSERT_TRUE(file_util::ReadFileToString(path_, &contents));
+
+  // Not a session file.
+  std::string garbage("This is not a session file.");
+  ASSERT_EQ(static_cast<int>(garbage.size()),
+            file_util::WriteFile(path_, garbage.data(), garbage.size()));
+  {
+    SessionFileReader reader;
+    EXPECT_FALSE(reader.Open(path_));
+  }
+
+  // A truncated file loses its trailer.
+  std::string truncated(contents, 0, contents.size() - 1);
+  ASSERT_EQ(static_cast<int>(truncated.size()),
+            file_util::WriteFile(path_, truncated.data(), truncated.size()));
+  {
+    SessionFileReader reader;
+    EXPECT_FALSE(reader.Open(path_));
+  }
+
+  // A corrupt chunk is only detected once read.
+  std::string corrupt(contents);
+  for (size_t i = 30; i < 60; ++i)
+    corrupt[i] = ~corrupt[i];
+  ASSERT_EQ(static_cast<int>(corrupt.size()),
+            file_util::WriteFile(path_, corrupt.data(), corrupt.size()));
+  {
+    SessionFileReader reader;
+    ASSERT_TRUE(reader.Open(path_));
+    ASSERT_EQ(1U, reader.chunk_count());
+    SessionChunk rows;
+    EXPECT_FALSE(reader.ReadChunk(0, &rows));
+  }
+}
+
+}  // namespace
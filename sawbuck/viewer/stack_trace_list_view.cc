@@ -67,9 +67,18 @@ void StackTraceListView::SetStackTrace(sym_util::ProcessId pid,
     CancelResolution(&*it);
 
   trace_.clear();
-  for (size_t i = 0; i < num_traces; ++i)
+  for (size_t i = 0; i < num_traces; ++i) {
     trace_.push_back(TraceItem(traces[i]));
 
+    // Take over the prefetch request for the frame, if there's one.
+    PrefetchMap::iterator prefetch(pending_prefetches_.find(
+        SymbolKey(pid_, time_, trace_.back().address_)));
+    if (prefetch != pending_prefetches_.end()) {
+      trace_.back().lookup_handle_ = prefetch->second;
+      pending_prefetches_.erase(prefetch);
+    }
+  }
+
   DeleteAllItems();
 
   // Clear the old stack trace and get the new one.
@@ -81,6 +90,39 @@ void StackTraceListView::SetStackTrace(sym_util::ProcessId pid,
     for (int col = COL_MODULE; col < COL_MAX; ++col) {
       SetItem(item, 1, LVIF_TEXT, LPSTR_TEXTCALLBACK, 0, 0, 0, NULL);
     }
+
+    // Display the frames resolved already.
+    SymbolMap::const_iterator symbol(resolved_symbols_.find(
+        SymbolKey(pid_, time_, trace_[i].address_)));
+    if (symbol != resolved_symbols_.end())
+      SetSymbolText(item, symbol->second);
+  }
+}
+
+void StackTraceListView::PrefetchStackTrace(sym_util::ProcessId pid,
+                                            const base::Time& time,
+                                            size_t num_traces,
+                                            void* traces[]) {
+  if (lookup_service_ == NULL)
+    return;
+
+  for (size_t i = 0; i < num_traces; ++i) {
+    // Don't swamp the lookup service while the user scrolls around.
+    if (pending_prefetches_.size() >= kMaxPendingPrefetches)
+      return;
+
+    SymbolKey key(pid, time, reinterpret_cast<sym_util::Address>(traces[i]));
+    if (resolved_symbols_.find(key) != resolved_symbols_.end() ||
+        pending_prefetches_.find(key) != pending_prefetches_.end()) {
+      continue;
+    }
+
+    ISymbolLookupService::Handle handle = lookup_service_->ResolveAddress(
+        pid, time, key.address_,
+        base::Bind(&StackTraceListView::SymbolResolved,
+                   base::Unretained(this)));
+    if (handle != ISymbolLookupService::kInvalidHandle)
+      pending_prefetches_[key] = handle;
   }
 }
 
@@ -148,6 +190,14 @@ LRESULT StackTraceListView::OnItemChanged(NMHDR* pnmh) {
   return 0;
 }
 
+bool StackTraceListView::SymbolKey::operator<(const SymbolKey& other) const {
+  if (pid_ != other.pid_)
+    return pid_ < other.pid_;
+  if (time_ != other.time_)
+    return time_ < other.time_;
+  return address_ < other.address_;
+}
+
 void StackTraceListView::EnsureResolution(TraceItem* item) {
   DCHECK(item != NULL);
   if (item->lookup_handle_ != ISymbolLookupService::kInvalidHandle)
@@ -173,6 +223,17 @@ void StackTraceListView::CancelResolution(TraceItem* item) {
 void StackTraceListView::SymbolResolved(sym_util::ProcessId pid,
     base::Time time, sym_util::Address address,
     ISymbolLookupService::Handle handle, const sym_util::Symbol& symbol) {
+  SymbolKey key(pid, time, address);
+  if (resolved_symbols_.size() >= kMaxResolvedSymbols)
+    resolved_symbols_.clear();
+  resolved_symbols_[key] = symbol;
+
+  // A prefetch request that wasn't taken over has nothing to display.
+  PrefetchMap::iterator prefetch(pending_prefetches_.find(key));
+  if (prefetch != pending_prefetches_.end() && prefetch->second == handle) {
+    pending_prefetches_.erase(prefetch);
+    return;
+  }
 
   size_t row = 0;
   for (; row < trace_.size(); ++row) {
@@ -181,10 +242,18 @@ void StackTraceListView::SymbolResolved(sym_util::ProcessId pid,
   }
 
   // We should always find our associated handle.
-  DCHECK(trace_[row].lookup_handle_ == handle);
+  DCHECK(row < trace_.size());
+  if (row == trace_.size())
+    return;
+
   // No longer pending, make sure we don't cancel it later.
   trace_[row].lookup_handle_ = ISymbolLookupService::kInvalidHandle;
 
+  SetSymbolText(row, symbol);
+}
+
+void StackTraceListView::SetSymbolText(int row,
+                                       const sym_util::Symbol& symbol) {
   for (int col = COL_MODULE; col < COL_MAX; ++col) {
     std::wstring item_text;
     switch (col) {
@@ -21,6 +21,7 @@
 #include <atlcrack.h>
 #include <atlctrls.h>
 #include <atlmisc.h>
+#include <map>
 #include <string>
 #include <vector>
 #include "base/time.h"
@@ -66,6 +67,17 @@ class StackTraceListView
                      size_t num_traces,
                      void* traces[]);
 
+  // Starts resolving the symbols of a stack trace in the background, so
+  // that they display right away if it's set later on.
+  // @param pid the process where the trace was captured.
+  // @param time the time the trace was captured.
+  // @param num_traces the number of frames in @p traces.
+  // @param traces the frames of the trace.
+  void PrefetchStackTrace(sym_util::ProcessId pid,
+                          const base::Time& time,
+                          size_t num_traces,
+                          void* traces[]);
+
   // Our column definitions and config data to satisfy our contract
   // to the ListViewImpl superclass.
   static const ColumnInfo kColumns[];
@@ -111,11 +123,29 @@ class StackTraceListView
     sym_util::Address address_;
   };
 
+  // Identifies the symbol of an address in a process at a time.
+  struct SymbolKey {
+    SymbolKey(sym_util::ProcessId pid,
+              const base::Time& time,
+              sym_util::Address address)
+        : pid_(pid), time_(time), address_(address) {
+    }
+
+    bool operator<(const SymbolKey& other) const;
+
+    sym_util::ProcessId pid_;
+    base::Time time_;
+    sym_util::Address address_;
+  };
+
   // Start resolving the address in item, unless it's already being resolved.
   void EnsureResolution(TraceItem* item);
   // Cancel any resolution pending for item.
   void CancelResolution(TraceItem* item);
 
+  // Displays @p symbol in the columns of @p row.
+  void SetSymbolText(int row, const sym_util::Symbol& symbol);
+
   // Callback for symbol resolution.
   void SymbolResolved(sym_util::ProcessId pid, base::Time time,
       sym_util::Address address, ISymbolLookupService::Handle handle,
@@ -132,6 +162,18 @@ class StackTraceListView
   typedef std::vector<TraceItem> TraceList;
   TraceList trace_;
 
+  // The symbols resolved so far, so that traces resolved ahead of time
+  // display right away. This is cleared once it reaches its maximum size.
+  typedef std::map<SymbolKey, sym_util::Symbol> SymbolMap;
+  static const size_t kMaxResolvedSymbols = 8192;
+  SymbolMap resolved_symbols_;
+
+  // The handles of the prefetch requests in flight. Prefetching stops
+  // while this is at its maximum size.
+  typedef std::map<SymbolKey, ISymbolLookupService::Handle> PrefetchMap;
+  static const size_t kMaxPendingPrefetches = 1024;
+  PrefetchMap pending_prefetches_;
+
   // Temporary storage for strings returned from OnGetDispInfo.
   std::wstring item_text_;
 };
@@ -0,0 +1,252 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Event rate timeline window implementation.
+#include "sawbuck/viewer/timeline_view.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+
+namespace {
+
+// The colors of the severity classes.
+const COLORREF kSeverityColors[EventTimeline::NUM_SEVERITY_CLASSES] = {
+  RGB(220, 40, 40),  // ERRORS.
+  RGB(240, 170, 0),  // WARNINGS.
+  RGB(60, 140, 220),  // INFORMATION.
+  RGB(150, 150, 150),  // VERBOSE.
+  RGB(200, 200, 200),  // OTHER.
+};
+
+// The smallest span of time displayed, in buckets of the finest level.
+const int kMinVisibleBuckets = 10;
+
+}  // namespace
+
+TimelineView::TimelineView()
+    : log_view_(NULL),
+      event_cookie_(0),
+      counted_rows_(0),
+      timeline_(base::TimeDelta::FromMilliseconds(kResolutionMs)),
+      event_sink_(NULL) {
+}
+
+TimelineView::~TimelineView() {
+}
+
+void TimelineView::SetLogView(ILogView* log_view) {
+  if (log_view_ == log_view)
+    return;
+
+  if (log_view_ != NULL) {
+    log_view_->Unregister(event_cookie_);
+    event_cookie_ = 0;
+  }
+
+  log_view_ = log_view;
+  timeline_.Clear();
+  counted_rows_ = 0;
+  view_start_ = base::Time();
+  view_span_ = base::TimeDelta();
+
+  if (log_view_ != NULL) {
+    log_view_->Register(this, &event_cookie_);
+    CountNewRows();
+  }
+}
+
+void TimelineView::LogViewNewItems() {
+  CountNewRows();
+}
+
+void TimelineView::LogViewCleared() {
+  timeline_.Clear();
+  counted_rows_ = 0;
+  view_start_ = base::Time();
+  view_span_ = base::TimeDelta();
+  if (IsWindow())
+    Invalidate();
+}
+
+void TimelineView::OnDestroy() {
+  if (log_view_ != NULL) {
+    log_view_->Unregister(event_cookie_);
+    log_view_ = NULL;
+  }
+}
+
+BOOL TimelineView::OnEraseBkgnd(CDCHandle dc) {
+  // The background is painted along with the chart.
+  return TRUE;
+}
+
+void TimelineView::OnPaint(CDCHandle /* dc */) {
+  CPaintDC dc(m_hWnd);
+  CRect client;
+  GetClientRect(&client);
+  dc.FillSolidRect(&client, ::GetSysColor(COLOR_WINDOW));
+
+  painted_bucket_width_ = base::TimeDelta();
+  if (timeline_.empty() || client.Width() <= 0 || client.Height() <= 0)
+    return;
+
+  // Only read the buckets that are displayed, at most one per pixel.
+  base::Time start;
+  base::Time end;
+  GetVisibleSpan(&start, &end);
+  std::vector<EventTimeline::Counts> buckets;
+  base::TimeDelta width = timeline_.GetBuckets(start, end, client.Width(),
+                                               &painted_first_bucket_,
+                                               &buckets);
+  if (buckets.empty())
+    return;
+  painted_bucket_width_ = width;
+
+  uint32 max_total = 1;
+  for (size_t i = 0; i < buckets.size(); ++i)
+    max_total = std::max(max_total, buckets[i].total());
+
+  // Stack the severity classes from the bottom, the most severe first.
+  for (size_t i = 0; i < buckets.size(); ++i) {
+    base::Time bucket_start =
+        painted_first_bucket_ + width * static_cast<int64>(i);
+    int left = TimeToX(bucket_start, client);
+    int right = std::max(TimeToX(bucket_start + width, client), left + 1);
+
+    uint32 stacked = 0;
+    int bottom = client.bottom;
+    for (size_t j = 0; j < EventTimeline::NUM_SEVERITY_CLASSES; ++j) {
+      stacked += buckets[i].counts[j];
+      int top = client.bottom - static_cast<int>(
+          static_cast<int64>(stacked) * client.Height() / max_total);
+      if (top < bottom) {
+        dc.FillSolidRect(left, top, right - left, bottom - top,
+                         kSeverityColors[j]);
+        bottom = top;
+      }
+    }
+  }
+}
+
+void TimelineView::OnLButtonDown(UINT flags, CPoint point) {
+  SetFocus();
+  if (log_view_ == NULL || event_sink_ == NULL ||
+      painted_bucket_width_ == base::TimeDelta()) {
+    return;
+  }
+
+  // Select the first row of the clicked bucket.
+  CRect client;
+  GetClientRect(&client);
+  base::TimeDelta offset = XToTime(point.x, client) - painted_first_bucket_;
+  int64 bucket = offset.InMicroseconds() /
+      painted_bucket_width_.InMicroseconds();
+  base::Time bucket_start = painted_first_bucket_ +
+      painted_bucket_width_ * std::max<int64>(bucket, 0);
+
+  int row = EventTimeline::FindRowAtTime(log_view_, bucket_start);
+  if (row >= 0)
+    event_sink_->TimelineRowSelected(row);
+}
+
+void TimelineView::OnLButtonDblClk(UINT flags, CPoint point) {
+  view_start_ = base::Time();
+  view_span_ = base::TimeDelta();
+  Invalidate();
+}
+
+BOOL TimelineView::OnMouseWheel(UINT flags, short delta, CPoint point) {
+  if (timeline_.empty())
+    return TRUE;
+
+  CRect client;
+  GetClientRect(&client);
+  ScreenToClient(&point);
+  if (client.Width() <= 0)
+    return TRUE;
+
+  // Zoom in or out by a factor of two, keeping the time under the cursor
+  // in place.
+  base::Time start;
+  base::Time end;
+  GetVisibleSpan(&start, &end);
+  base::Time cursor = XToTime(point.x, client);
+  int64 span = (end - start).InMicroseconds();
+  int64 new_span = delta > 0 ? span / 2 : span * 2;
+  int64 min_span = static_cast<int64>(kMinVisibleBuckets) * kResolutionMs *
+      base::Time::kMicrosecondsPerMillisecond;
+  new_span = std::max(new_span, min_span);
+
+  int64 full_span = (timeline_.end_time() - timeline_.start_time()).
+      InMicroseconds();
+  if (new_span >= full_span) {
+    // Back to the whole timeline, which follows the new rows.
+    view_start_ = base::Time();
+    view_span_ = base::TimeDelta();
+  } else {
+    int64 cursor_offset = (cursor - start).InMicroseconds();
+    view_start_ = cursor - base::TimeDelta::FromMicroseconds(
+        cursor_offset * new_span / std::max<int64>(span, 1));
+    view_span_ = base::TimeDelta::FromMicroseconds(new_span);
+  }
+  Invalidate();
+  return TRUE;
+}
+
+void TimelineView::CountNewRows() {
+  DCHECK(log_view_ != NULL);
+
+  int num_rows = log_view_->GetNumRows();
+  if (counted_rows_ == num_rows)
+    return;
+
+  for (; counted_rows_ < num_rows; ++counted_rows_) {
+    timeline_.AddRow(log_view_->GetTime(counted_rows_),
+                     log_view_->GetSeverity(counted_rows_));
+  }
+  if (IsWindow())
+    Invalidate();
+}
+
+void TimelineView::GetVisibleSpan(base::Time* start, base::Time* end) const {
+  DCHECK(start != NULL);
+  DCHECK(end != NULL);
+
+  if (view_start_.is_null()) {
+    *start = timeline_.start_time();
+    *end = timeline_.end_time();
+  } else {
+    *start = view_start_;
+    *end = view_start_ + view_span_;
+  }
+}
+
+int TimelineView::TimeToX(base::Time time, const CRect& client) const {
+  base::Time start;
+  base::Time end;
+  GetVisibleSpan(&start, &end);
+  int64 span = std::max<int64>((end - start).InMicroseconds(), 1);
+  return client.left + static_cast<int>(
+      (time - start).InMicroseconds() * client.Width() / span);
+}
+
+base::Time TimelineView::XToTime(int x, const CRect& client) const {
+  base::Time start;
+  base::Time end;
+  GetVisibleSpan(&start, &end);
+  int64 span = (end - start).InMicroseconds();
+  return start + base::TimeDelta::FromMicroseconds(
+      (x - client.left) * span / std::max(client.Width(), 1));
+}
@@ -0,0 +1,114 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Event rate timeline window declaration.
+#ifndef SAWBUCK_VIEWER_TIMELINE_VIEW_H_
+#define SAWBUCK_VIEWER_TIMELINE_VIEW_H_
+
+#include <atlbase.h>
+#include <atlapp.h>
+#include <atlwin.h>
+#include <atlcrack.h>
+#include <atlgdi.h>
+#include <atlmisc.h>
+#include "base/time.h"
+#include "sawbuck/viewer/event_timeline.h"
+#include "sawbuck/viewer/log_list_view.h"
+
+// Callback interface for TimelineView.
+class ITimelineViewEvents {
+ public:
+  // Called on the UI thread when a bucket of the timeline is clicked.
+  // @param row the first row stamped at or after the start of the bucket.
+  virtual void TimelineRowSelected(int row) = 0;
+};
+
+// A window that charts the rates of the messages of a log view over time,
+// stacked by severity. It counts the rows as they are appended to the log
+// view. The mouse wheel zooms in and out around the cursor, a double-click
+// shows the whole log again, and a click selects the first row of the
+// clicked bucket.
+class TimelineView
+    : public CWindowImpl<TimelineView>,
+      public ILogViewEvents {
+ public:
+  DECLARE_WND_CLASS_EX(L"SawbuckTimelineView", CS_DBLCLKS, COLOR_WINDOW)
+
+  BEGIN_MSG_MAP_EX(TimelineView)
+    MSG_WM_DESTROY(OnDestroy)
+    MSG_WM_ERASEBKGND(OnEraseBkgnd)
+    MSG_WM_PAINT(OnPaint)
+    MSG_WM_LBUTTONDOWN(OnLButtonDown)
+    MSG_WM_LBUTTONDBLCLK(OnLButtonDblClk)
+    MSG_WM_MOUSEWHEEL(OnMouseWheel)
+  END_MSG_MAP()
+
+  TimelineView();
+  ~TimelineView();
+
+  // Sets the log view to chart, and counts its rows.
+  void SetLogView(ILogView* log_view);
+
+  void set_event_sink(ITimelineViewEvents* event_sink) {
+    event_sink_ = event_sink;
+  }
+
+  // ILogViewEvents implementation.
+  virtual void LogViewNewItems();
+  virtual void LogViewCleared();
+
+  // The span of time of the finest buckets.
+  static const int kResolutionMs = 100;
+
+ private:
+  void OnDestroy();
+  BOOL OnEraseBkgnd(CDCHandle dc);
+  void OnPaint(CDCHandle dc);
+  void OnLButtonDown(UINT flags, CPoint point);
+  void OnLButtonDblClk(UINT flags, CPoint point);
+  BOOL OnMouseWheel(UINT flags, short delta, CPoint point);
+
+  // Counts the rows of the log view that haven't been counted yet.
+  void CountNewRows();
+
+  // Gets the span of time displayed.
+  void GetVisibleSpan(base::Time* start, base::Time* end) const;
+
+  // Converts between times and horizontal positions in the client area.
+  int TimeToX(base::Time time, const CRect& client) const;
+  base::Time XToTime(int x, const CRect& client) const;
+
+  // The log view charted, and the number of its rows counted.
+  ILogView* log_view_;
+  int event_cookie_;
+  int counted_rows_;
+
+  // The counts of the rows of the log view.
+  EventTimeline timeline_;
+
+  // The span of time displayed, or a null start to display the whole
+  // timeline.
+  base::Time view_start_;
+  base::TimeDelta view_span_;
+
+  // The buckets as last painted, to map clicks to buckets.
+  base::Time painted_first_bucket_;
+  base::TimeDelta painted_bucket_width_;
+
+  ITimelineViewEvents* event_sink_;
+
+  DISALLOW_COPY_AND_ASSIGN(TimelineView);
+};
+
+#endif  // SAWBUCK_VIEWER_TIMELINE_VIEW_H_
@@ -0,0 +1,180 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Trigram index implementation.
+#include "sawbuck/viewer/trigram_index.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "base/logging.h"
+#include "base/string_util.h"
+
+namespace {
+
+// The estimated overhead of a trigram in the posting map.
+const size_t kPostingOverhead = 4 * sizeof(void*);
+
+// The characters that have a meaning in a regular expression.
+const char kRegExpChars[] = "\\^$.|?*+()[]{}";
+
+// The characters that make the atom preceding them optional.
+const char kOptionalChars[] = "?*{";
+
+}  // namespace
+
+TrigramIndex::TrigramIndex() : memory_size_(0) {
+}
+
+TrigramIndex::~TrigramIndex() {
+}
+
+void TrigramIndex::AddRow(int row, const base::StringPiece& text) {
+  if (text.size() < kTrigramLength)
+    return;
+
+  for (size_t i = 0; i + kTrigramLength <= text.size(); ++i) {
+    std::pair<PostingMap::iterator, bool> result =
+        postings_.insert(std::make_pair(GetTrigram(text.data() + i),
+                                        RowList()));
+    if (result.second)
+      memory_size_ += kPostingOverhead + sizeof(PostingMap::value_type);
+
+    // A row appears once per trigram, however many times it contains it.
+    RowList& rows = result.first->second;
+    DCHECK(rows.empty() || rows.back() <= row);
+    if (!rows.empty() && rows.back() == row)
+      continue;
+
+    size_t capacity = rows.capacity();
+    rows.push_back(row);
+    memory_size_ += (rows.capacity() - capacity) * sizeof(int);
+  }
+}
+
+void TrigramIndex::Clear() {
+  postings_.clear();
+  memory_size_ = 0;
+}
+
+bool TrigramIndex::GetCandidateRows(const std::string& literal,
+                                    std::vector<int>* rows) const {
+  DCHECK(rows != NULL);
+
+  rows->clear();
+  if (literal.size() < kTrigramLength)
+    return false;
+
+  // Gather the row lists of the trigrams of the literal, shortest first.
+  std::vector<std::pair<size_t, const RowList*> > lists;
+  for (size_t i = 0; i + kTrigramLength <= literal.size(); ++i) {
+    PostingMap::const_iterator it =
+        postings_.find(GetTrigram(literal.data() + i));
+    if (it == postings_.end())
+      return true;
+    lists.push_back(std::make_pair(it->second.size(), &it->second));
+  }
+  std::sort(lists.begin(), lists.end());
+
+  // Intersect them.
+  *rows = *lists[0].second;
+  std::vector<int> intersection;
+  for (size_t i = 1; i < lists.size() && !rows->empty(); ++i) {
+    intersection.clear();
+    std::set_intersection(rows->begin(), rows->end(),
+                          lists[i].second->begin(), lists[i].second->end(),
+                          std::back_inserter(intersection));
+    rows->swap(intersection);
+  }
+
+  return true;
+}
+
+bool TrigramIndex::ExtractLiteral(const std::string& expression,
+                                  std::string* literal) {
+  DCHECK(literal != NULL);
+
+  literal->clear();
+
+  // An alternation makes every part of the expression optional, and inline
+  // options may change what the characters of the expression match.
+  if (expression.find('|') != std::string::npos ||
+      expression.find("(?") != std::string::npos) {
+    return false;
+  }
+
+  // Find the longest run of characters that match themselves, outside of any
+  // group or class, and not followed by a quantifier that makes them
+  // optional.
+  std::string run;
+  size_t i = 0;
+  while (i < expression.size()) {
+    char c = expression[i];
+    bool is_literal = false;
+    size_t next = i + 1;
+
+    if (c == '\\') {
+      // An escaped meta character matches itself, other escapes denote
+      // classes or assertions.
+      next = i + 2;
+      if (i + 1 < expression.size() &&
+          strchr(kRegExpChars, expression[i + 1]) != NULL) {
+        c = expression[i + 1];
+        is_literal = true;
+      }
+    } else if (c == '(' || c == '[' || c == '{') {
+      // Skip groups, classes and counted quantifiers altogether.
+      char close = c == '(' ? ')' : (c == '[' ? ']' : '}');
+      int depth = 1;
+      while (next < expression.size() && depth > 0) {
+        char d = expression[next++];
+        if (d == '\\')
+          ++next;
+        else if (d == '(' && c == '(')
+          ++depth;
+        else if (d == close)
+          --depth;
+      }
+    } else if (c >= ' ' && c < 0x7F && strchr(kRegExpChars, c) == NULL) {
+      // Only ASCII characters are folded the way the index does.
+      is_literal = true;
+    }
+
+    // A quantifier may make the character optional.
+    if (is_literal && next < expression.size() &&
+        strchr(kOptionalChars, expression[next]) != NULL) {
+      is_literal = false;
+    }
+
+    if (is_literal) {
+      run.push_back(c);
+    } else {
+      if (run.size() > literal->size())
+        literal->swap(run);
+      run.clear();
+    }
+    i = next;
+  }
+  if (run.size() > literal->size())
+    literal->swap(run);
+
+  return literal->size() >= kTrigramLength;
+}
+
+TrigramIndex::Trigram TrigramIndex::GetTrigram(const char* text) {
+  DCHECK(text != NULL);
+  return (static_cast<uint8>(ToLowerASCII(text[0])) << 16) |
+      (static_cast<uint8>(ToLowerASCII(text[1])) << 8) |
+      static_cast<uint8>(ToLowerASCII(text[2]));
+}
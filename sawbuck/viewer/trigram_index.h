@@ -0,0 +1,94 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Trigram index declaration.
+#ifndef SAWBUCK_VIEWER_TRIGRAM_INDEX_H_
+#define SAWBUCK_VIEWER_TRIGRAM_INDEX_H_
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/hash_tables.h"
+#include "base/string_piece.h"
+
+// An incremental index of the trigrams of the texts of a list of rows, used
+// to narrow text searches down to the rows that may match. The trigrams are
+// folded to lower-case ASCII, so the candidates of a search hold for case
+// sensitive and insensitive searches alike.
+//
+// Sample usage:
+//
+//   TrigramIndex index;
+//   index.AddRow(0, "Some text");
+//   ...
+//   std::string literal;
+//   std::vector<int> rows;
+//   if (TrigramIndex::ExtractLiteral(expression, &literal) &&
+//       index.GetCandidateRows(literal, &rows)) {
+//     // Only the rows in |rows| may match |expression|.
+//   }
+class TrigramIndex {
+ public:
+  TrigramIndex();
+  ~TrigramIndex();
+
+  // Indexes the text of a row. The rows must be added in increasing order.
+  // @param row the row.
+  // @param text the text of the row.
+  void AddRow(int row, const base::StringPiece& text);
+
+  // Removes all the rows from the index.
+  void Clear();
+
+  // Gets the rows whose text may contain @p literal, ignoring the case.
+  // @param literal the text to look for.
+  // @param rows receives the candidate rows, in increasing order.
+  // @returns false if @p literal is too short for the index to narrow the
+  //     search down, true otherwise.
+  bool GetCandidateRows(const std::string& literal,
+                        std::vector<int>* rows) const;
+
+  // @returns the approximate size of the index, in bytes.
+  size_t memory_size() const { return memory_size_; }
+
+  // Extracts a literal string that any text matching a regular expression
+  // must contain, ignoring the case.
+  // @param expression the regular expression.
+  // @param literal receives the longest such literal that could be found.
+  // @returns true if a literal long enough to use with the index was found.
+  static bool ExtractLiteral(const std::string& expression,
+                             std::string* literal);
+
+  // The length of the indexed n-grams.
+  static const size_t kTrigramLength = 3;
+
+ private:
+  typedef uint32 Trigram;
+  typedef std::vector<int> RowList;
+  typedef base::hash_map<Trigram, RowList> PostingMap;
+
+  // @returns the trigram starting at @p text.
+  static Trigram GetTrigram(const char* text);
+
+  // The rows each trigram appears in, in increasing order.
+  PostingMap postings_;
+
+  // The approximate size of the index.
+  size_t memory_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(TrigramIndex);
+};
+
+#endif  // SAWBUCK_VIEWER_TRIGRAM_INDEX_H_
@@ -0,0 +1,84 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "sawbuck/viewer/trigram_index.h"
+
+#include "gtest/gtest.h"
+
+namespace {
+
+TEST(TrigramIndexTest, GetCandidateRows) {
+  TrigramIndex index;
+  EXPECT_EQ(0U, index.memory_size());
+
+  index.AddRow(0, "Hello world");
+  index.AddRow(1, "");
+  index.AddRow(2, "Goodbye WORLD");
+  index.AddRow(3, "worldworld");
+  index.AddRow(4, "wor ld");
+  EXPECT_LT(0U, index.memory_size());
+
+  std::vector<int> rows;
+  EXPECT_FALSE(index.GetCandidateRows("wo", &rows));
+  EXPECT_TRUE(rows.empty());
+
+  ASSERT_TRUE(index.GetCandidateRows("World", &rows));
+  ASSERT_EQ(3U, rows.size());
+  EXPECT_EQ(0, rows[0]);
+  EXPECT_EQ(2, rows[1]);
+  EXPECT_EQ(3, rows[2]);
+
+  ASSERT_TRUE(index.GetCandidateRows("hello", &rows));
+  ASSERT_EQ(1U, rows.size());
+  EXPECT_EQ(0, rows[0]);
+
+  ASSERT_TRUE(index.GetCandidateRows("missing", &rows));
+  EXPECT_TRUE(rows.empty());
+
+  index.Clear();
+  EXPECT_EQ(0U, index.memory_size());
+  ASSERT_TRUE(index.GetCandidateRows("World", &rows));
+  EXPECT_TRUE(rows.empty());
+}
+
+TEST(TrigramIndexTest, ExtractLiteral) {
+  std::string literal;
+  EXPECT_TRUE(TrigramIndex::ExtractLiteral("hello", &literal));
+  EXPECT_EQ("hello", literal);
+
+  EXPECT_TRUE(TrigramIndex::ExtractLiteral("^foo.*barbaz$", &literal));
+  EXPECT_EQ("barbaz", literal);
+
+  // Optional characters end a literal.
+  EXPECT_TRUE(TrigramIndex::ExtractLiteral("abcd?efg", &literal));
+  EXPECT_EQ("abc", literal);
+  EXPECT_TRUE(TrigramIndex::ExtractLiteral("abcde{0,2}fg", &literal));
+  EXPECT_EQ("abcd", literal);
+
+  // Escaped meta characters match themselves.
+  EXPECT_TRUE(TrigramIndex::ExtractLiteral("file\\.cc", &literal));
+  EXPECT_EQ("file.cc", literal);
+  EXPECT_TRUE(TrigramIndex::ExtractLiteral("ab\\dcdef", &literal));
+  EXPECT_EQ("cdef", literal);
+
+  // Groups and classes are skipped.
+  EXPECT_TRUE(TrigramIndex::ExtractLiteral("(abcdef)?xyz", &literal));
+  EXPECT_EQ("xyz", literal);
+  EXPECT_FALSE(TrigramIndex::ExtractLiteral("[abcdef]xy", &literal));
+
+  // Alternations have no mandatory literal.
+  EXPECT_FALSE(TrigramIndex::ExtractLiteral("hello|world", &literal));
+  EXPECT_FALSE(TrigramIndex::ExtractLiteral("ab", &literal));
+}
+
+}  // namespace
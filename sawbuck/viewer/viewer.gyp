@@ -64,11 +64,17 @@
       'target_name': 'viewer',
       'type': 'static_library',
       'sources': [
+        'column_index.cc',
+        'column_index.h',
         'const_config.h',
+        'event_timeline.cc',
+        'event_timeline.h',
         'filter.cc',
         'filter.h',
         'filter_dialog.cc',
         'filter_dialog.h',
+        'filter_program.cc',
+        'filter_program.h',
         'filtered_log_view.cc',
         'filtered_log_view.h',
         'find_dialog.cc',
@@ -77,22 +83,36 @@
         'log_viewer.cc',
         'log_list_view.h',
         'log_list_view.cc',
+        'log_store.cc',
+        'log_store.h',
         'preferences.cc',
         'preferences.h',
         'provider_configuration.cc',
         'provider_configuration.h',
         'provider_dialog.cc',
         'provider_dialog.h',
+        'row_bitmap.cc',
+        'row_bitmap.h',
+        'row_text_cache.cc',
+        'row_text_cache.h',
         'sawbuck_guids.h',
+        'session_file.cc',
+        'session_file.h',
         'stack_trace_list_view.h',
         'stack_trace_list_view.cc',
+        'timeline_view.cc',
+        'timeline_view.h',
+        'trigram_index.cc',
+        'trigram_index.h',
         'viewer_window.cc',
         'viewer_window.h',
       ],
       'dependencies': [
+        '../common/common.gyp:common',
         '../log_lib/log_lib.gyp:log_lib',
         '<(DEPTH)/base/base.gyp:base',
         '<(DEPTH)/third_party/pcre/pcre.gyp:pcre_lib',
+        '<(DEPTH)/third_party/zlib/zlib.gyp:zlib',
       ],
     },
     {
@@ -146,13 +166,21 @@
       'target_name': 'viewer_unittests',
       'type': 'executable',
       'sources': [
+        'column_index_unittest.cc',
+        'event_timeline_unittest.cc',
+        'filter_program_unittest.cc',
         'filter_unittest.cc',
         'filtered_log_view_unittest.cc',
+        'log_store_unittest.cc',
         'preferences_unittest.cc',
         'provider_configuration_unittest.cc',
         'registry_test.h',
         'registry_test.cc',
+        'row_bitmap_unittest.cc',
+        'row_text_cache_unittest.cc',
         'sawbuck_guids.h',
+        'session_file_unittest.cc',
+        'trigram_index_unittest.cc',
         'viewer_unittest_main.cc',
         'viewer_window_unittest.cc',
         'viewer.rc',
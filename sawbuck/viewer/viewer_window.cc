@@ -20,14 +20,19 @@
 #include "base/environment.h"
 #include "base/file_util.h"
 #include "base/logging.h"
+#include "base/memory/scoped_vector.h"
 #include "base/path_service.h"
 #include "base/string_util.h"
 #include "base/stringprintf.h"
+#include "base/threading/simple_thread.h"
 #include "base/utf_string_conversions.h"
 #include "base/win/event_trace_consumer.h"
+#include "sawbuck/log_lib/event_ring.h"
+#include "sawbuck/log_lib/log_archive.h"
 #include "sawbuck/viewer/const_config.h"
 #include "sawbuck/viewer/preferences.h"
 #include "sawbuck/viewer/provider_dialog.h"
+#include "sawbuck/viewer/session_file.h"
 #include "sawbuck/viewer/viewer_module.h"
 #include <initguid.h>  // NOLINT
 
@@ -44,6 +49,13 @@ const pcrecpp::RE kFileRe("\\[[^\\]]*\\:([^:]+)\\((\\d+)\\)\\].(.*\\w).*",
 
 const wchar_t kSessionName[] = L"Sawbuck Log Session";
 
+// How often the capture sessions are tuned.
+const int kTuneSessionsIntervalMs = 2000;
+// The most memory each of the capture sessions may take for its buffers.
+const ULONG kMaxSessionBufferMemoryKb = 16 * 1024;
+// The time granularity of the CPU profile of the log.
+const int kCpuProfileResolutionMs = 100;
+
 bool Is64BitSystem() {
   if (sizeof(void*) == 8)  // NOLINT
     return true;
@@ -78,17 +90,22 @@ void ViewerWindow::CompileAsserts() {
 ViewerWindow::ViewerWindow()
      : symbol_lookup_worker_("Symbol Lookup Worker"),
        next_sink_cookie_(1),
+       cpu_profile_(base::TimeDelta::FromMilliseconds(kCpuProfileResolutionMs)),
        log_viewer_(this),
        ui_loop_(NULL),
        notify_log_view_new_items_(
           base::Bind(&ViewerWindow::NotifyLogViewNewItems,
                      base::Unretained(this))),
        notify_log_view_new_items_pending_(false),
+       message_index_size_(0),
        update_status_task_(base::Bind(&ViewerWindow::UpdateStatus,
                                       base::Unretained(this))),
        update_status_task_pending_(false),
        log_consumer_thread_("Event log consumer"),
-       kernel_consumer_thread_("Kernel log consumer") {
+       kernel_consumer_thread_("Kernel log consumer"),
+       import_thread_("Log importer"),
+       importing_(false),
+       lost_events_(0) {
   ui_loop_ = MessageLoop::current();
   DCHECK(ui_loop_ != NULL);
 
@@ -101,9 +118,11 @@ ViewerWindow::ViewerWindow()
 
   symbol_lookup_service_.set_background_thread(
       symbol_lookup_worker_.message_loop());
+  symbol_lookup_service_.set_kernel_timeline(&kernel_timeline_);
 
   InitSymbolPath();
   symbol_lookup_service_.SetSymbolPath(symbol_path_.c_str());
+  InitSymbolCacheFile();
 
   settings_.ReadProviders();
   settings_.ReadSettings();
@@ -113,6 +132,8 @@ ViewerWindow::~ViewerWindow() {
   // Last resort..
   StopCapturing();
 
+  // Let any import run to completion.
+  import_thread_.Stop();
   symbol_lookup_worker_.Stop();
 
   notify_log_view_new_items_.Cancel();
@@ -121,23 +142,100 @@ ViewerWindow::~ViewerWindow() {
 
 namespace {
 
+// Decodes the events of log files on a decoding thread, while the thread
+// that consumes the files keeps reading them. Both threads keep the events
+// in timestamp order, as ETW merges the files. Log archives and saved
+// sessions are read once the log files are consumed.
 class ImportLogConsumer
     : public base::win::EtwTraceConsumerBase<ImportLogConsumer>,
       public LogParser,
-      public KernelLogParser {
+      public KernelLogParser,
+      public base::DelegateSimpleThread::Delegate {
  public:
-  ImportLogConsumer();
+  typedef base::Callback<void(const wchar_t*)> StatusCallback;
+  typedef base::Callback<bool(const SessionFileReader*)> SessionLoader;
+
+  explicit ImportLogConsumer(const StatusCallback& status_callback);
   ~ImportLogConsumer();
 
+  // Opens @p path, either a log file, a log archive or a saved session.
+  HRESULT OpenFile(const FilePath& path);
+
+  // Sets the sinks for the messages of the log archives.
+  void set_archive_sinks(LogEvents* log_event_sink,
+                         TraceEvents* trace_event_sink) {
+    archive_reader_.set_event_sink(log_event_sink);
+    archive_reader_.set_trace_sink(trace_event_sink);
+  }
+
+  // Sets the callback that loads the saved sessions.
+  void set_session_loader(const SessionLoader& session_loader) {
+    session_loader_ = session_loader;
+  }
+
+  // Consumes the opened files, reporting progress to the status callback.
+  HRESULT Import();
+
   static void ProcessEvent(PEVENT_TRACE event);
 
  private:
+  // DelegateSimpleThread::Delegate implementation, decodes events in
+  // batches until all files are consumed.
+  virtual void Run();
+
+  // Decodes the events handed off so far.
+  void DecodeEvents();
+
+  // Reports the number of events decoded so far.
+  void ReportProgress();
+
+  // Reads the opened log archives.
+  HRESULT ImportArchives();
+
+  // Loads the opened sessions.
+  HRESULT ImportSessions();
+
   static ImportLogConsumer* current_;
+
+  // The number of events handed off to the decoding thread at a time.
+  static const size_t kRingCapacity = 16 * 1024;
+
+  // Hands the events off from the consuming thread to the decoding thread.
+  EventRing ring_;
+
+  // Signaled when events are ready for the decoding thread.
+  base::WaitableEvent events_pending_;
+
+  // Set to non-zero once the files are consumed.
+  volatile base::subtle::Atomic32 consumed_;
+
+  // On the decoding thread.
+  StatusCallback status_callback_;
+  size_t decoded_events_;
+  base::Time start_time_;
+  base::Time last_report_time_;
+
+  // True if any log file was opened.
+  bool has_sessions_;
+
+  // The opened log archives.
+  std::vector<FILE*> archives_;
+  LogArchiveReader archive_reader_;
+
+  // The opened sessions.
+  ScopedVector<SessionFileReader> sessions_;
+  SessionLoader session_loader_;
 };
 
 ImportLogConsumer* ImportLogConsumer::current_ = NULL;
 
-ImportLogConsumer::ImportLogConsumer() {
+ImportLogConsumer::ImportLogConsumer(const StatusCallback& status_callback)
+    : ring_(kRingCapacity),
+      events_pending_(false, false),
+      consumed_(0),
+      status_callback_(status_callback),
+      decoded_events_(0),
+      has_sessions_(false) {
   DCHECK(current_ == NULL);
   current_ = this;
 }
@@ -145,28 +243,163 @@ ImportLogConsumer::ImportLogConsumer() {
 ImportLogConsumer::~ImportLogConsumer() {
   DCHECK(current_ == this);
   current_ = NULL;
+
+  for (size_t i = 0; i < archives_.size(); ++i)
+    file_util::CloseFile(archives_[i]);
+}
+
+HRESULT ImportLogConsumer::OpenFile(const FilePath& path) {
+  if (_wcsicmp(path.Extension().c_str(), kSessionFileExtension) == 0) {
+    scoped_ptr<SessionFileReader> session(new SessionFileReader());
+    if (!session->Open(path))
+      return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+
+    sessions_.push_back(session.release());
+    return S_OK;
+  }
+
+  if (_wcsicmp(path.Extension().c_str(), kLogArchiveExtension) != 0) {
+    HRESULT hr = OpenFileSession(path.value().c_str());
+    if (SUCCEEDED(hr))
+      has_sessions_ = true;
+    return hr;
+  }
+
+  FILE* archive = file_util::OpenFile(path, "rb");
+  if (archive == NULL)
+    return HRESULT_FROM_WIN32(::GetLastError());
+
+  archives_.push_back(archive);
+  return S_OK;
+}
+
+HRESULT ImportLogConsumer::Import() {
+  start_time_ = base::Time::Now();
+  last_report_time_ = start_time_;
+
+  HRESULT hr = S_OK;
+  if (has_sessions_) {
+    base::DelegateSimpleThread decoding_thread(this, "Log import decoder");
+    decoding_thread.Start();
+
+    hr = Consume();
+
+    base::subtle::Release_Store(&consumed_, 1);
+    events_pending_.Signal();
+    decoding_thread.Join();
+  }
+
+  if (SUCCEEDED(hr))
+    hr = ImportArchives();
+  if (SUCCEEDED(hr))
+    hr = ImportSessions();
+
+  return hr;
+}
+
+HRESULT ImportLogConsumer::ImportArchives() {
+  for (size_t i = 0; i < archives_.size(); ++i) {
+    if (!archive_reader_.Read(archives_[i]))
+      return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+  }
+
+  return S_OK;
+}
+
+HRESULT ImportLogConsumer::ImportSessions() {
+  DCHECK(sessions_.empty() || !session_loader_.is_null());
+
+  for (size_t i = 0; i < sessions_.size(); ++i) {
+    if (!session_loader_.Run(sessions_[i]))
+      return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+  }
+
+  return S_OK;
 }
 
 void ImportLogConsumer::ProcessEvent(PEVENT_TRACE event) {
   DCHECK(current_ != NULL);
 
-  if (!current_->LogParser::ProcessOneEvent(event) &&
-      !current_->KernelLogParser::ProcessOneEvent(event)) {
-    LOG(INFO) << "Unknown event";
+  // Unlike a real-time session, the files can wait for the decoding thread
+  // to catch up.
+  while (!current_->ring_.Push(event)) {
+    current_->events_pending_.Signal();
+    ::Sleep(1);
   }
+
+  if (current_->ring_.size() == kRingCapacity / 4)
+    current_->events_pending_.Signal();
+}
+
+void ImportLogConsumer::Run() {
+  const base::TimeDelta kPollInterval = base::TimeDelta::FromMilliseconds(20);
+  while (base::subtle::Acquire_Load(&consumed_) == 0) {
+    events_pending_.TimedWait(kPollInterval);
+    DecodeEvents();
+    ReportProgress();
+  }
+
+  // Catch up with the last events.
+  DecodeEvents();
+}
+
+void ImportLogConsumer::DecodeEvents() {
+  EVENT_TRACE* event = ring_.Front();
+  for (; event != NULL; event = ring_.Front()) {
+    if (!LogParser::ProcessOneEvent(event) &&
+        !KernelLogParser::ProcessOneEvent(event)) {
+      LOG(INFO) << "Unknown event";
+    }
+    ring_.Pop();
+    ++decoded_events_;
+  }
+}
+
+void ImportLogConsumer::ReportProgress() {
+  base::Time now = base::Time::Now();
+  if (status_callback_.is_null() ||
+      now - last_report_time_ < base::TimeDelta::FromSeconds(1)) {
+    return;
+  }
+
+  last_report_time_ = now;
+  double seconds = (now - start_time_).InSecondsF();
+  std::wstring status =
+      StringPrintf(L"Importing: %d events, %.0f events/s\r\n",
+                   static_cast<int>(decoded_events_),
+                   decoded_events_ / seconds);
+  status_callback_.Run(status.c_str());
+}
+
+// Imports logs on the import thread, then reports the result on the UI
+// thread.
+void ImportLogs(ImportLogConsumer* consumer,
+                MessageLoop* ui_loop,
+                const base::Callback<void(HRESULT)>& done_callback) {
+  DCHECK(consumer != NULL);
+
+  HRESULT hr = consumer->Import();
+  ui_loop->PostTask(FROM_HERE, base::Bind(done_callback, hr));
 }
 
 }  // namespace
 
 void ViewerWindow::ImportLogFiles(const std::vector<FilePath>& paths) {
+  if (importing_) {
+    ::MessageBox(m_hWnd, L"Logs are already being imported.",
+                 L"Error Importing Logs", MB_OK);
+    return;
+  }
+
   UISetText(0, L"Importing");
   UIUpdateStatusBar();
 
-  ImportLogConsumer import_consumer;
+  scoped_ptr<ImportLogConsumer> import_consumer(
+      new ImportLogConsumer(status_callback_));
 
   // Open all the log files.
   for (size_t i = 0; i < paths.size(); ++i) {
-    HRESULT hr = import_consumer.OpenFileSession(paths[i].value().c_str());
+    HRESULT hr = import_consumer->OpenFile(paths[i]);
 
     if (FAILED(hr)) {
       std::wstring msg =
@@ -180,14 +413,33 @@ void ViewerWindow::ImportLogFiles(const std::vector<FilePath>& paths) {
   }
 
   // Attach our event sinks to the consumer.
-  import_consumer.set_event_sink(this);
-  import_consumer.set_trace_sink(this);
-  import_consumer.set_process_event_sink(&process_info_service_);
-  import_consumer.set_module_event_sink(&symbol_lookup_service_);
-
-  // Consume the files.
-  // TODO(siggi): Report progress here.
-  HRESULT hr = import_consumer.Consume();
+  import_consumer->set_event_sink(this);
+  import_consumer->set_trace_sink(this);
+  import_consumer->set_archive_sinks(this, this);
+  import_consumer->set_session_loader(
+      base::Bind(&ViewerWindow::LoadSession, base::Unretained(this)));
+  import_consumer->set_process_event_sink(&kernel_timeline_);
+  import_consumer->set_module_event_sink(&kernel_timeline_);
+  import_consumer->set_profile_event_sink(&cpu_profile_);
+
+  // Consume the files on the import thread, so that the log can be browsed
+  // as its rows come in.
+  if (!import_thread_.IsRunning())
+    CHECK(import_thread_.Start());
+  importing_ = true;
+  import_thread_.message_loop()->PostTask(FROM_HERE,
+      base::Bind(&ImportLogs,
+                 base::Owned(import_consumer.release()),
+                 ui_loop_,
+                 base::Bind(&ViewerWindow::OnImportDone,
+                            base::Unretained(this))));
+}
+
+void ViewerWindow::OnImportDone(HRESULT hr) {
+  DCHECK_EQ(ui_loop_, MessageLoop::current());
+  DCHECK(importing_);
+
+  importing_ = false;
   if (FAILED(hr)) {
     std::wstring msg =
         StringPrintf(L"Import failed with error 0x%08X",
@@ -195,12 +447,39 @@ void ViewerWindow::ImportLogFiles(const std::vector<FilePath>& paths) {
     ::MessageBox(m_hWnd, msg.c_str(), L"Error Importing Logs", MB_OK);
   }
 
-  UISetText(0, L"Ready");
-  UIUpdateStatusBar();
+  OnStatusUpdate(L"Ready\r\n");
+}
+
+bool ViewerWindow::LoadSession(const SessionFileReader* reader) {
+  DCHECK(reader != NULL);
+
+  SessionChunk rows;
+  for (size_t i = 0; i < reader->chunk_count(); ++i) {
+    // Decompress outside the lock, so as not to hold up the other writers.
+    if (!reader->ReadChunk(i, &rows))
+      return false;
+
+    base::AutoLock lock(list_lock_);
+    size_t first_row = log_store_.size();
+    size_t appended = reader->AppendChunk(rows, &log_store_);
+    for (size_t j = 0; j < appended; ++j) {
+      message_index_.AddRow(first_row + j, rows.GetMessage(j));
+      column_index_.AddRow(first_row + j, rows.GetLevel(j),
+                           rows.GetProcessId(j), rows.GetThreadId(j));
+    }
+
+    ScheduleNewItemsNotification();
+    if (appended != rows.size())
+      return false;
+  }
+
+  return true;
 }
 
 const wchar_t kLogFileFilter[] =
     L"Event Trace Files\0*.etl\0"
+    L"Log Archives\0*.sawlog\0"
+    L"Sawbuck Sessions\0*.sawbuck\0"
     L"All Files\n\0*.*\0";
 
 void ViewerWindow::SetCapture(bool capture) {
@@ -251,6 +530,41 @@ LRESULT ViewerWindow::OnImport(
   return 0;
 }
 
+const wchar_t kSessionFileFilter[] =
+    L"Sawbuck Sessions\0*.sawbuck\0"
+    L"All Files\0*.*\0";
+
+LRESULT ViewerWindow::OnSaveSession(
+    WORD code, LPARAM lparam, HWND wnd, BOOL& handled) {
+  CFileDialog dialog(FALSE, kSessionFileExtension + 1, NULL,
+                     OFN_HIDEREADONLY | OFN_OVERWRITEPROMPT,
+                     kSessionFileFilter, m_hWnd);
+  if (dialog.DoModal() != IDOK)
+    return 0;
+
+  // Save the rows as displayed, so that a filtered view saves just the
+  // rows that pass the filters.
+  FilePath path(dialog.m_szFileName);
+  FILE* file = file_util::OpenFile(path, "wb");
+  bool saved = false;
+  if (file != NULL) {
+    CWaitCursor wait_cursor;
+    SessionFileWriter writer(file);
+    saved = writer.Write(log_viewer_.GetDisplayedLogView());
+    file_util::CloseFile(file);
+  }
+
+  if (!saved) {
+    file_util::Delete(path, false);
+    std::wstring msg =
+        StringPrintf(L"Failed to save the session to \"%ls\"",
+                     path.value().c_str());
+    ::MessageBox(m_hWnd, msg.c_str(), L"Error Saving Session", MB_OK);
+  }
+
+  return 0;
+}
+
 LRESULT ViewerWindow::OnExit(
     WORD code, LPARAM lparam, HWND wnd, BOOL& handled) {
   PostMessage(WM_CLOSE);
@@ -265,6 +579,10 @@ LRESULT ViewerWindow::OnAbout(
 }
 
 void ViewerWindow::StopCapturing() {
+  tune_timer_.Stop();
+  log_tuner_.reset();
+  kernel_tuner_.reset();
+
   log_controller_.Stop(NULL);
   kernel_controller_.Stop(NULL);
   log_consumer_thread_.Stop();
@@ -349,7 +667,9 @@ bool ViewerWindow::StartCapturing() {
   if (FAILED(hr))
     return false;
 
-  // Consume it in a new thread.
+  // Consume it in a new thread, which hands the events off to yet another
+  // thread for decoding, so as not to hold up the session.
+  log_consumer_->StartDecoding();
   CHECK(log_consumer_thread_.Start());
   log_consumer_thread_.message_loop()->PostTask(FROM_HERE,
       base::Bind(base::IgnoreResult(&LogConsumer::Consume),
@@ -364,8 +684,9 @@ bool ViewerWindow::StartCapturing() {
   p->Wnode.ClientContext = 1;
   p->LogFileMode = EVENT_TRACE_REAL_TIME_MODE;
   p->MaximumFileSize = 100;  // 100 M file size.
-  // Get image load and process events.
-  p->EnableFlags = EVENT_TRACE_FLAG_IMAGE_LOAD | EVENT_TRACE_FLAG_PROCESS;
+  // Get image load, process and CPU sample events.
+  p->EnableFlags = EVENT_TRACE_FLAG_IMAGE_LOAD | EVENT_TRACE_FLAG_PROCESS |
+      EVENT_TRACE_FLAG_PROFILE;
   p->FlushTimer = 1;  // flush every second.
   p->BufferSize = 16;  // 16 K buffers.
   hr = kernel_controller_.Start(KERNEL_LOGGER_NAME, &kernel_props);
@@ -375,8 +696,9 @@ bool ViewerWindow::StartCapturing() {
   // And open a consumer on it.
   kernel_consumer_.reset(new KernelLogConsumer());
   DCHECK(NULL != kernel_consumer_.get());
-  kernel_consumer_->set_module_event_sink(&symbol_lookup_service_);
-  kernel_consumer_->set_process_event_sink(&process_info_service_);
+  kernel_consumer_->set_module_event_sink(&kernel_timeline_);
+  kernel_consumer_->set_process_event_sink(&kernel_timeline_);
+  kernel_consumer_->set_profile_event_sink(&cpu_profile_);
   kernel_consumer_->set_is_64_bit_log(Is64BitSystem());
   hr = kernel_consumer_->OpenRealtimeSession(KERNEL_LOGGER_NAME);
   if (FAILED(hr))
@@ -391,6 +713,22 @@ bool ViewerWindow::StartCapturing() {
   if (SUCCEEDED(hr))
     EnableProviders(settings_);
 
+  // Keep an eye on the sessions, and grow their buffers if they can't keep
+  // up with the events. The log session is also kept flushing every second,
+  // so that sparse messages show up promptly.
+  EtwSessionTuner::Options options;
+  options.max_buffer_memory_kb = kMaxSessionBufferMemoryKb;
+  options.min_flush_timer = 1;
+  options.low_latency = true;
+  log_tuner_.reset(new EtwSessionTuner(kSessionName, options));
+  options.low_latency = false;
+  kernel_tuner_.reset(new EtwSessionTuner(KERNEL_LOGGER_NAME, options));
+  lost_events_ = 0;
+  tune_timer_.Start(FROM_HERE,
+                    base::TimeDelta::FromMilliseconds(kTuneSessionsIntervalMs),
+                    this,
+                    &ViewerWindow::TuneSessions);
+
   return SUCCEEDED(hr);
 }
 
@@ -405,37 +743,46 @@ void ViewerWindow::EnableProviders(
 }
 
 void ViewerWindow::OnLogMessage(const LogEvents::LogMessage& log_message) {
-  ViewerWindow::LogMessage msg;
-  msg.level = log_message.level;
-  msg.process_id = log_message.process_id;
-  msg.thread_id = log_message.thread_id;
-  msg.time_stamp = log_message.time;
+  // The file and message refer to the event buffer, they're only copied if
+  // the store interns or keeps them.
+  pcrecpp::StringPiece file;
+  int line = 0;
+  pcrecpp::StringPiece message;
 
   // Use regular expression matching to extract the
   // file/line/message from the log string, which is of
   // format "[<stuff>:<file>(<line>)] <message><ws>".
   if (!kFileRe.FullMatch(
       pcrecpp::StringPiece(log_message.message, log_message.message_len),
-                           &msg.file, &msg.line, &msg.message)) {
+                           &file, &line, &message)) {
     // As fallback, just slurp the entire string.
-    msg.message.assign(log_message.message, log_message.message_len);
+    message.set(log_message.message, log_message.message_len);
   }
 
   // If the message carried file information, use that
   // in preference to the above.
   if (log_message.file_len != 0) {
-    msg.file.assign(log_message.file, log_message.file_len);
-    msg.line = log_message.line;
-  }
-
-  if (log_message.trace_depth > 0) {
-    msg.trace.insert(msg.trace.begin(),
-                     &log_message.traces[0],
-                     &log_message.traces[log_message.trace_depth - 1]);
+    file.set(log_message.file, log_message.file_len);
+    line = log_message.line;
   }
+  base::StringPiece file_text(file.data(), file.size());
+  base::StringPiece message_text(message.data(), message.size());
 
   base::AutoLock lock(list_lock_);
-  log_messages_.push_back(msg);
+  int row = log_store_.size();
+  if (log_store_.Append(log_message.level,
+                        log_message.process_id,
+                        log_message.thread_id,
+                        log_message.time,
+                        file_text,
+                        line,
+                        message_text,
+                        log_message.traces,
+                        log_message.trace_depth)) {
+    message_index_.AddRow(row, message_text);
+    column_index_.AddRow(row, log_message.level, log_message.process_id,
+                         log_message.thread_id);
+  }
 
   ScheduleNewItemsNotification();
 }
@@ -476,7 +823,38 @@ void ViewerWindow::UpdateStatus() {
     status = status_;
   }
 
-  UISetText(0, status.c_str());
+  ShowStatus(status);
+}
+
+void ViewerWindow::ShowStatus(const std::wstring& status) {
+  DCHECK_EQ(MessageLoop::current(), ui_loop_);
+
+  std::wstring text(status);
+  if (message_index_size_ != 0) {
+    text += StringPrintf(L" [Search index: %.1f MB]",
+                         message_index_size_ / (1024.0 * 1024.0));
+  }
+  if (lost_events_ != 0)
+    text += StringPrintf(L" [Lost events: %u]", lost_events_);
+  UISetText(0, text.c_str());
+}
+
+void ViewerWindow::TuneSessions() {
+  DCHECK_EQ(MessageLoop::current(), ui_loop_);
+  DCHECK(log_tuner_.get() != NULL);
+  DCHECK(kernel_tuner_.get() != NULL);
+
+  // Failures are benign, the session keeps its current settings.
+  log_tuner_->Tune();
+  kernel_tuner_->Tune();
+
+  ULONG lost_events = log_tuner_->events_lost() + log_tuner_->buffers_lost() +
+      kernel_tuner_->events_lost() + kernel_tuner_->buffers_lost();
+  if (lost_events != lost_events_) {
+    lost_events_ = lost_events;
+    base::AutoLock lock(status_lock_);
+    ShowStatus(status_);
+  }
 }
 
 void ViewerWindow::OnTraceEventBegin(
@@ -496,26 +874,30 @@ void ViewerWindow::OnTraceEventInstant(
 
 void ViewerWindow::AddTraceEventToLog(const char* type,
     const TraceEvents::TraceMessage& trace_message) {
-  ViewerWindow::LogMessage msg;
-  msg.level = trace_message.level;
-  msg.process_id = trace_message.process_id;
-  msg.thread_id = trace_message.thread_id;
-  msg.time_stamp = trace_message.time;
-
   // The message will be of form "{BEGIN|END|INSTANT}(<name>, 0x<id>): <extra>"
-  msg.message = StringPrintf("%s(%*s, 0x%08X): %*s",
-                             type,
-                             trace_message.name_len,
-                             trace_message.name,
-                             trace_message.id,
-                             trace_message.extra_len,
-                             trace_message.extra);
-
-  for (size_t i = 0; i < trace_message.trace_depth; ++i)
-    msg.trace.push_back(trace_message.traces[i]);
+  std::string message = StringPrintf("%s(%*s, 0x%08X): %*s",
+                                     type,
+                                     trace_message.name_len,
+                                     trace_message.name,
+                                     trace_message.id,
+                                     trace_message.extra_len,
+                                     trace_message.extra);
 
   base::AutoLock lock(list_lock_);
-  log_messages_.push_back(msg);
+  int row = log_store_.size();
+  if (log_store_.Append(trace_message.level,
+                        trace_message.process_id,
+                        trace_message.thread_id,
+                        trace_message.time,
+                        base::StringPiece(),
+                        0,
+                        message,
+                        trace_message.traces,
+                        trace_message.trace_depth)) {
+    message_index_.AddRow(row, message);
+    column_index_.AddRow(row, trace_message.level, trace_message.process_id,
+                         trace_message.thread_id);
+  }
 
   ScheduleNewItemsNotification();
 }
@@ -532,11 +914,22 @@ void ViewerWindow::ScheduleNewItemsNotification() {
 
 void ViewerWindow::NotifyLogViewNewItems() {
   DCHECK_EQ(ui_loop_, MessageLoop::current());
+  size_t message_index_size = 0;
   {
     base::AutoLock lock(list_lock_);
 
     // Notification no longer pending.
     notify_log_view_new_items_pending_ = false;
+    message_index_size = message_index_.memory_size();
+  }
+
+  // Refresh the status bar when the index has grown by a tenth of a MB.
+  const size_t kStatusGranularity = 100 * 1024;
+  if (message_index_size / kStatusGranularity !=
+      message_index_size_ / kStatusGranularity) {
+    message_index_size_ = message_index_size;
+    base::AutoLock lock(status_lock_);
+    ShowStatus(status_);
   }
 
   EventSinkMap::iterator it(event_sinks_.begin());
@@ -678,8 +1071,10 @@ int ViewerWindow::OnCreate(LPCREATESTRUCT lpCreateStruct) {
   SetWindowText(L"Sawbuck Log Viewer");
 
   log_viewer_.SetLogView(this);
+  log_viewer_.SetLogViewIndex(this);
   log_viewer_.SetSymbolLookupService(&symbol_lookup_service_);
-  log_viewer_.SetProcessInfoService(&process_info_service_);
+  log_viewer_.SetProcessInfoService(kernel_timeline_.process_info());
+  log_viewer_.SetCpuProfile(&cpu_profile_, &symbol_lookup_service_);
 
   log_viewer_.Create(m_hWnd,
                      NULL,
@@ -738,56 +1133,74 @@ void ViewerWindow::OnDestroy() {
 }
 
 int ViewerWindow::GetNumRows() {
-  base::AutoLock lock(list_lock_);
-  return log_messages_.size();
+  return log_store_.size();
 }
 
 void ViewerWindow::ClearAll() {
+  // The readers are on the UI thread, so none of them can be accessing the
+  // store while it's cleared.
+  DCHECK_EQ(ui_loop_, MessageLoop::current());
   {
     base::AutoLock lock(list_lock_);
-    log_messages_.clear();
+    log_store_.Clear();
+    message_index_.Clear();
+    column_index_.Clear();
   }
+  cpu_profile_.Clear();
+  message_index_size_ = 0;
   NotifyLogViewCleared();
 }
 
 int ViewerWindow::GetSeverity(int row) {
-  base::AutoLock lock(list_lock_);
-  return log_messages_[row].level;
+  return log_store_.GetLevel(row);
 }
 
 DWORD ViewerWindow::GetProcessId(int row) {
-  base::AutoLock lock(list_lock_);
-  return log_messages_[row].process_id;
+  return log_store_.GetProcessId(row);
 }
 
 DWORD ViewerWindow::GetThreadId(int row) {
-  base::AutoLock lock(list_lock_);
-  return log_messages_[row].thread_id;
+  return log_store_.GetThreadId(row);
 }
 
 base::Time ViewerWindow::GetTime(int row) {
-  base::AutoLock lock(list_lock_);
-  return log_messages_[row].time_stamp;
+  return log_store_.GetTime(row);
 }
 
 std::string ViewerWindow::GetFileName(int row) {
-  base::AutoLock lock(list_lock_);
-  return log_messages_[row].file;
+  return log_store_.GetFileName(row);
 }
 
 int ViewerWindow::GetLine(int row) {
-  base::AutoLock lock(list_lock_);
-  return log_messages_[row].line;
+  return log_store_.GetLine(row);
 }
 
 std::string ViewerWindow::GetMessage(int row) {
-  base::AutoLock lock(list_lock_);
-  return log_messages_[row].message;
+  return log_store_.GetMessage(row).as_string();
 }
 
 void ViewerWindow::GetStackTrace(int row, std::vector<void*>* trace) {
+  log_store_.GetStackTrace(row, trace);
+}
+
+bool ViewerWindow::GetCandidateRows(const std::string& literal,
+                                    std::vector<int>* rows) {
+  // The index is updated by the log consumer threads, so it can't be read
+  // without the lock, unlike the store.
   base::AutoLock lock(list_lock_);
-  *trace = log_messages_[row].trace;
+  return message_index_.GetCandidateRows(literal, rows);
+}
+
+bool ViewerWindow::GetColumnRows(ColumnIndex::Column column,
+                                 const std::vector<int>& values,
+                                 int start,
+                                 int end,
+                                 RowBitmap* rows) {
+  // The rows are indexed as they're appended, under the lock, so all the
+  // rows the store has published are indexed.
+  base::AutoLock lock(list_lock_);
+  column_index_.GetRows(column, values, start, end, rows);
+  return true;
 }
 
 void ViewerWindow::Register(ILogViewEvents* event_sink,
@@ -802,6 +1215,19 @@ void ViewerWindow::Unregister(int registration_cookie) {
   event_sinks_.erase(registration_cookie);
 }
 
+void ViewerWindow::InitSymbolCacheFile() {
+  FilePath app_data_dir;
+  if (!PathService::Get(base::DIR_LOCAL_APP_DATA, &app_data_dir))
+    return;
+
+  FilePath cache_dir(app_data_dir.Append(L"Sawbuck"));
+  if (!file_util::CreateDirectory(cache_dir))
+    return;
+
+  symbol_lookup_service_.SetSymbolCacheFile(
+      cache_dir.Append(L"symbol_cache.txt"));
+}
+
 void ViewerWindow::InitSymbolPath() {
   {
     // Attempt to read our current preference if one exists.
@@ -32,21 +32,29 @@
 #include "base/memory/scoped_ptr.h"
 #include "base/synchronization/lock.h"
 #include "base/threading/thread.h"
+#include "base/timer.h"
 #include "base/win/event_trace_controller.h"
+#include "sawbuck/common/etw_session_tuner.h"
+#include "sawbuck/log_lib/cpu_profile.h"
 #include "sawbuck/log_lib/kernel_log_consumer.h"
+#include "sawbuck/log_lib/kernel_timeline.h"
 #include "sawbuck/log_lib/log_consumer.h"
-#include "sawbuck/log_lib/process_info_service.h"
 #include "sawbuck/log_lib/symbol_lookup_service.h"
+#include "sawbuck/viewer/column_index.h"
+#include "sawbuck/viewer/log_store.h"
 #include "sawbuck/viewer/log_viewer.h"
 #include "sawbuck/viewer/provider_configuration.h"
 #include "sawbuck/viewer/resource.h"
+#include "sawbuck/viewer/trigram_index.h"
 
+class SessionFileReader;
 
 class ViewerWindow
     : public CFrameWindowImpl<ViewerWindow>,
       public LogEvents,
       public TraceEvents,
       public ILogView,
+      public ILogViewIndex,
       public CIdleHandler,
       public CMessageFilter,
       public CUpdateUI<ViewerWindow> {
@@ -58,6 +66,7 @@ class ViewerWindow
     MSG_WM_CREATE(OnCreate)
     MSG_WM_DESTROY(OnDestroy)
     COMMAND_ID_HANDLER(ID_FILE_IMPORT, OnImport)
+    COMMAND_ID_HANDLER(ID_FILE_SAVE_SESSION, OnSaveSession)
     COMMAND_ID_HANDLER(ID_FILE_EXIT, OnExit)
     COMMAND_ID_HANDLER(ID_APP_ABOUT, OnAbout)
     COMMAND_ID_HANDLER(ID_LOG_CONFIGUREPROVIDERS, OnConfigureProviders)
@@ -104,14 +113,26 @@ class ViewerWindow
                         int* registration_cookie);
   virtual void Unregister(int registration_cookie);
 
+  // ILogViewIndex implementation.
+  virtual bool GetCandidateRows(const std::string& literal,
+                                std::vector<int>* rows);
+  virtual bool GetColumnRows(ColumnIndex::Column column,
+                             const std::vector<int>& values,
+                             int start,
+                             int end,
+                             RowBitmap* rows);
+
   // Turn capturing on or off.
   virtual void SetCapture(bool capture);
 
-  // Consumes the logs in paths.
+  // Consumes the logs in paths in the background. The rows show up as they
+  // are decoded, and progress is reported in the status bar. Paths may also
+  // name log archives and saved sessions.
   void ImportLogFiles(const std::vector<FilePath>& paths);
 
  private:
   LRESULT OnImport(WORD code, LPARAM lparam, HWND wnd, BOOL& handled);
+  LRESULT OnSaveSession(WORD code, LPARAM lparam, HWND wnd, BOOL& handled);
   LRESULT OnExit(WORD code, LPARAM lparam, HWND wnd, BOOL& handled);
   LRESULT OnAbout(WORD code, LPARAM lparam, HWND wnd, BOOL& handled);
   LRESULT OnConfigureProviders(WORD code, LPARAM lparam, HWND wnd,
@@ -133,6 +154,9 @@ class ViewerWindow
  private:
   // Initializes the symbol path.
   void InitSymbolPath();
+  // Points the symbol lookup service to the symbols resolved in previous
+  // sessions.
+  void InitSymbolCacheFile();
 
   // Called on UI thread to dispatch notifications to listeners.
   void NotifyLogViewNewItems();
@@ -145,6 +169,17 @@ class ViewerWindow
   void OnStatusUpdate(const wchar_t* status);
   // Invoked on the UI thread to update our status.
   void UpdateStatus();
+  // Invoked on the UI thread once logs are imported.
+  void OnImportDone(HRESULT hr);
+  // Invoked on the import thread to append the messages of a saved session
+  // to the log. Returns false if the session is corrupt or the log is full.
+  bool LoadSession(const SessionFileReader* reader);
+  // Displays |status| in the status bar, along with the size of the index
+  // and the number of events the capture sessions lost.
+  void ShowStatus(const std::wstring& status);
+  // Invoked periodically on the UI thread while capturing to adjust the
+  // buffers of the capture sessions to the event rate.
+  void TuneSessions();
 
   // TraceEvents implementation.
   void OnTraceEventBegin(const TraceEvents::TraceMessage& trace_message);
@@ -164,26 +199,22 @@ class ViewerWindow
   // The currently configured symbol path.
   std::wstring symbol_path_;
 
-  struct LogMessage {
-    LogMessage() : level(0), process_id(0), thread_id(0), line(0) {
-    }
-
-    UCHAR level;
-    DWORD process_id;
-    DWORD thread_id;
-    base::Time time_stamp;
-    std::string file;
-    int line;
-    std::string message;
-    std::vector<void*> trace;
-  };
-
   // We dedicate a thread to the symbol lookup work.
   base::Thread symbol_lookup_worker_;
 
+  // Serializes the writers of log_store_. The readers, which all run on the
+  // UI thread, don't take it: they only see the rows the store has published.
+  // Clearing the store happens on the UI thread too, under the lock.
   base::Lock list_lock_;
-  typedef std::vector<LogMessage> LogMessageList;
-  LogMessageList log_messages_;  // Under list_lock_.
+  LogStore log_store_;
+
+  // Indexes the messages of log_store_ to speed up searches.
+  TrigramIndex message_index_;  // Under list_lock_.
+  // The size of message_index_ last displayed in the status bar.
+  size_t message_index_size_;  // On the UI thread.
+  // Indexes the severity, process id and thread id of the rows of
+  // log_store_ to speed up filtering.
+  ColumnIndex column_index_;  // Under list_lock_.
 
   typedef base::CancelableCallback<void()> NotifyNewItemsCallback;
 
@@ -199,8 +230,16 @@ class ViewerWindow
   EventSinkMap event_sinks_;
   int next_sink_cookie_;
 
+  // Takes care of sinking KernelModuleEvents and KernelProcessEvents for us,
+  // for both the symbol lookup and the process info.
+  KernelTimeline kernel_timeline_;
+
   // The symbol lookup service we provide to the log list view.
   SymbolLookupService symbol_lookup_service_;
+
+  // Sinks the CPU samples of the kernel log, for profiling the time ranges
+  // of the log list view.
+  CpuProfile cpu_profile_;
   typedef base::Callback<void(const wchar_t*)> StatusCallback;
   StatusCallback status_callback_;
 
@@ -210,10 +249,7 @@ class ViewerWindow
   std::wstring status_;  // Under status_lock_.
   bool update_status_task_pending_;  // Under status_lock_;
 
-  // Takes care of sinking KernelProcessEvents for us.
-  ProcessInfoService process_info_service_;
-
-  // The list view control that displays log_messages_.
+  // The list view control that displays log_store_.
   LogViewer log_viewer_;
 
   // Controller for the logging session.
@@ -225,11 +261,23 @@ class ViewerWindow
   // Controller for the kernel logging session.
   base::win::EtwTraceController kernel_controller_;
 
+  // Grow the buffers of the logging sessions when they lose events. Valid
+  // while capturing.
+  scoped_ptr<EtwSessionTuner> log_tuner_;
+  scoped_ptr<EtwSessionTuner> kernel_tuner_;
+  base::RepeatingTimer<ViewerWindow> tune_timer_;
+  // The number of events the capture sessions lost.
+  ULONG lost_events_;  // On the UI thread.
+
   // NULL until StartConsuming. Valid until StopConsuming.
   scoped_ptr<LogConsumer> log_consumer_;
   scoped_ptr<KernelLogConsumer> kernel_consumer_;
   base::Thread log_consumer_thread_;
   base::Thread kernel_consumer_thread_;
+
+  // Log files are imported on this thread.
+  base::Thread import_thread_;
+  bool importing_;  // On the UI thread.
 };
 
 #endif  // SAWBUCK_VIEWER_VIEWER_WINDOW_H_
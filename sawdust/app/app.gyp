@@ -113,6 +113,7 @@
       'dependencies': [
         '../tracer/tracer.gyp:tracer_lib',
         '<(DEPTH)/base/base.gyp:base',
+        '<(DEPTH)/sawbuck/log_lib/log_lib.gyp:log_lib',
       ],
     },
     {
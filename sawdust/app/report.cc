@@ -15,21 +15,30 @@
 // The logic and some lifting for report entries.
 #include "sawdust/app/report.h"
 
+#include <algorithm>
 #include <istream>  // NOLINT - streams used as abstracts, without formatting.
 #include <fstream>  // NOLINT
 #include "base/file_path.h"
 #include "base/file_util.h"
 #include "base/logging.h"
 #include "base/scoped_ptr.h"
+#include "base/string_number_conversions.h"
+#include "base/sys_info.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/simple_thread.h"
+#include "sawbuck/log_lib/log_archive.h"
+#include "sawbuck/log_lib/log_consumer.h"
 
 namespace {
 
-const char kChromeUploadTitle[] = "Application.etl";
-const char kKernelUploadTitle[] = "Kernel.etl";
+const char kChromeUploadTitle[] = "Application";
+const char kKernelUploadTitle[] = "Kernel";
+const char kUploadExtension[] = ".etl";
+const char kReducedUploadExtension[] = ".sawlog";
 
 class FileEntry : public ReportContent::ReportEntryWithInit {
  public:
-  FileEntry(const FilePath& file, const char * title)
+  FileEntry(const FilePath& file, const std::string& title)
       : file_path_(file), public_title_(title), marked_ok_(false) {
   }
 
@@ -61,6 +70,89 @@ class FileEntry : public ReportContent::ReportEntryWithInit {
   bool marked_ok_;
 };
 
+// Serves the messages of a set of log files as a single log archive, which
+// drops the trace buffers and collapses repeated messages. The archive is
+// written to a temporary file on initialization.
+class ReducedLogEntry : public ReportContent::ReportEntryWithInit {
+ public:
+  ReducedLogEntry(const std::vector<FilePath>& files, const std::string& title)
+      : file_paths_(files), public_title_(title), marked_ok_(false) {
+    DCHECK(!files.empty());
+  }
+
+  ~ReducedLogEntry() {
+    if (stream_.is_open())
+      stream_.close();
+    if (!archive_path_.empty())
+      file_util::Delete(archive_path_, false);
+    if (marked_ok_) {
+      for (size_t i = 0; i < file_paths_.size(); ++i)
+        file_util::Delete(file_paths_[i], false);
+    }
+  }
+
+  HRESULT Initialize() {
+    FILE* archive = file_util::CreateAndOpenTemporaryFile(&archive_path_);
+    if (archive == NULL) {
+      LOG(ERROR) << "Failed to create a temporary log archive.";
+      return E_FAIL;
+    }
+
+    HRESULT hr = WriteArchive(archive);
+    file_util::CloseFile(archive);
+    if (FAILED(hr))
+      return hr;
+
+    stream_.open(archive_path_.value().c_str(),
+                 std::ios_base::in | std::ios_base::binary);
+    return stream_.bad() ? E_ACCESSDENIED : S_OK;
+  }
+
+  std::istream& Data() { return stream_; }  // Override (IReportContentEntry).
+  const char* Title() const { return public_title_.c_str(); }
+
+  void MarkCompleted() {
+    marked_ok_ = true;
+  }
+
+ private:
+  HRESULT WriteArchive(FILE* archive) {
+    LogArchiveWriter writer(archive);
+    if (!writer.Init())
+      return E_FAIL;
+
+    LogConsumer consumer;
+    consumer.set_event_sink(&writer);
+    consumer.set_trace_sink(&writer);
+    for (size_t i = 0; i < file_paths_.size(); ++i) {
+      HRESULT hr = consumer.OpenFileSession(file_paths_[i].value().c_str());
+      if (FAILED(hr)) {
+        LOG(ERROR) << "Failed to open " << file_paths_[i].value()
+                   << ", error " << hr;
+        writer.Flush();
+        return hr;
+      }
+    }
+
+    HRESULT hr = consumer.Consume();
+    bool written = writer.Flush();
+    if (FAILED(hr)) {
+      LOG(ERROR) << "Failed to consume the application log, error " << hr;
+      return hr;
+    }
+
+    LOG(INFO) << "Collapsed " << writer.collapsed_messages()
+              << " repeated log messages.";
+    return written ? S_OK : E_FAIL;
+  }
+
+  std::ifstream stream_;
+  std::vector<FilePath> file_paths_;
+  FilePath archive_path_;
+  std::string public_title_;
+  bool marked_ok_;
+};
+
 class RegistryEntry : public ReportContent::ReportEntryWithInit {
  public:
   explicit RegistryEntry(const std::vector<std::wstring>& all_entries,
@@ -111,9 +203,57 @@ class BaseSystemInfoEntry : public ReportContent::ReportEntryWithInit {
   bool harvest_env_vars_;
 };
 
+// Gets the title of the |index|-th out of |count| files of a log. Rolling
+// logs span several files, which are numbered.
+std::string GetLogFileTitle(const char* title, size_t index, size_t count) {
+  std::string file_title(title);
+  if (count > 1)
+    file_title.append(".").append(base::IntToString(static_cast<int>(index)));
+  return file_title.append(kUploadExtension);
+}
+
 }  // namespace
 
+class ReportContent::PendingEntry
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  explicit PendingEntry(ReportEntryWithInit* entry)
+      : entry_(entry), result_(E_PENDING), done_(true, false) {
+    DCHECK(entry != NULL);
+  }
+
+  virtual void Run() {
+    result_ = entry_->Initialize();
+    done_.Signal();
+  }
+
+  // Releases the entry. This must only be called once it is initialized.
+  ReportEntryWithInit* ReleaseEntry() {
+    DCHECK(done_.IsSignaled());
+    return entry_.release();
+  }
+
+  base::WaitableEvent* done() { return &done_; }
+  HRESULT result() const { return result_; }
+
+ private:
+  scoped_ptr<ReportEntryWithInit> entry_;
+  HRESULT result_;
+  base::WaitableEvent done_;
+
+  DISALLOW_COPY_AND_ASSIGN(PendingEntry);
+};
+
+ReportContent::ReportContent() {
+}
+
 ReportContent::~ReportContent() {
+  // The workers reference the pending entries, so let them finish first.
+  if (pool_ != NULL)
+    pool_->JoinAll();
+  for (size_t i = 0; i < pending_entries_.size(); ++i)
+    delete pending_entries_[i];
+
   while (!entry_queue_.empty()) {
     delete entry_queue_.front();
     entry_queue_.pop_front();
@@ -122,18 +262,28 @@ ReportContent::~ReportContent() {
 
 HRESULT ReportContent::Initialize(const TracerController& controller,
                                   const TracerConfiguration& config) {
-  FilePath source_file_path;
+  std::vector<FilePath> source_file_paths;
 
-  if (!controller.GetCompletedEventLogFileName(&source_file_path)) {
+  if (!controller.GetCompletedEventLogFiles(&source_file_paths)) {
     LOG(ERROR) << "No data to upload. Weird.";
     return E_FAIL;
   }
-  entry_queue_.push_back(new FileEntry(source_file_path, kChromeUploadTitle));
+  if (config.ReduceLogs()) {
+    entry_queue_.push_back(new ReducedLogEntry(source_file_paths,
+        std::string(kChromeUploadTitle).append(kReducedUploadExtension)));
+  } else {
+    for (size_t i = 0; i < source_file_paths.size(); ++i) {
+      entry_queue_.push_back(new FileEntry(source_file_paths[i],
+          GetLogFileTitle(kChromeUploadTitle, i, source_file_paths.size())));
+    }
+  }
 
   if (config.IsKernelLoggingEnabled()) {
-    if (controller.GetCompletedKernelEventLogFileName(&source_file_path)) {
-      entry_queue_.push_back(new FileEntry(source_file_path,
-                                           kKernelUploadTitle));
+    if (controller.GetCompletedKernelEventLogFiles(&source_file_paths)) {
+      for (size_t i = 0; i < source_file_paths.size(); ++i) {
+        entry_queue_.push_back(new FileEntry(source_file_paths[i],
+            GetLogFileTitle(kKernelUploadTitle, i, source_file_paths.size())));
+      }
     } else {
       // Even though this is a failure, we will just pretend it is OK.
       // Better to upload something than nothing at all.
@@ -150,20 +300,53 @@ HRESULT ReportContent::Initialize(const TracerController& controller,
   entry_queue_.push_back(new BaseSystemInfoEntry(config,
                                                  CreateInfoExtractor()));
 
+  StartEntries();
   return S_OK;
 }
 
+void ReportContent::StartEntries() {
+  DCHECK(pool_ == NULL);
+  DCHECK(pending_entries_.empty());
+  if (entry_queue_.empty())
+    return;
+
+  // There's no point in having more workers than entries.
+  int num_threads = std::min(base::SysInfo::NumberOfProcessors(),
+                             static_cast<int>(entry_queue_.size()));
+  pool_.reset(new base::DelegateSimpleThreadPool("Report content",
+                                                 num_threads));
+  pool_->Start();
+
+  while (!entry_queue_.empty()) {
+    PendingEntry* pending_entry = new PendingEntry(entry_queue_.front());
+    entry_queue_.pop_front();
+    pending_entries_.push_back(pending_entry);
+    pool_->AddWork(pending_entry, 1);
+  }
+}
+
 HRESULT ReportContent::GetNextEntry(IReportContentEntry** entry) {
   DCHECK(entry != NULL);
   HRESULT hr = S_OK;
   current_entry_.reset();
-  if (entry_queue_.empty()) {
+  if (pending_entries_.empty()) {
     hr = S_FALSE;
   } else {
-    current_entry_.reset(entry_queue_.front());
-    entry_queue_.pop_front();
+    // Serve whichever entry is ready first. Only so many events can be
+    // waited for at once, which is plenty to keep the uploader busy.
+    std::vector<base::WaitableEvent*> events;
+    for (size_t i = 0; i < pending_entries_.size() &&
+                       events.size() < MAXIMUM_WAIT_OBJECTS; ++i) {
+      events.push_back(pending_entries_[i]->done());
+    }
+    size_t index = base::WaitableEvent::WaitMany(&events[0], events.size());
+    DCHECK_LT(index, events.size());
+
+    scoped_ptr<PendingEntry> pending_entry(pending_entries_[index]);
+    pending_entries_.erase(pending_entries_.begin() + index);
+    current_entry_.reset(pending_entry->ReleaseEntry());
     // If initialization fails, the error will percolate all the way up.
-    hr = current_entry_->Initialize();
+    hr = pending_entry->result();
   }
 
   if (SUCCEEDED(hr) && entry != NULL)
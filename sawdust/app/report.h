@@ -17,6 +17,7 @@
 #define SAWDUST_APP_REPORT_H_
 
 #include <list>
+#include <vector>
 
 #include "base/scoped_ptr.h"
 
@@ -26,19 +27,30 @@
 #include "sawdust/tracer/system_info.h"
 #include "sawdust/tracer/upload.h"
 
+namespace base {
+class DelegateSimpleThreadPool;
+}  // namespace base
+
 // The class serves all uploadable content, wrapping log files into own
 // specialization of IReportContentEntry. It will also include system info and
 // registry extraction if declared so in configuration.
+//
+// The entries are initialized concurrently on a pool of worker threads, and
+// served in the order in which they become ready. This lets the uploader start
+// on the first entry to be ready while the others are still being gathered.
 class ReportContent : public IReportContent {
  public:
-  ReportContent() {}
+  ReportContent();
   ~ReportContent();
 
   // Creates all required wrappers and extractors, as defined by |config|. Log
-  // files will be dug out from |controller|.
+  // files will be dug out from |controller|. Initialization of the entries is
+  // started before returning.
   HRESULT Initialize(const TracerController& controller,
                      const TracerConfiguration& config);
 
+  // Waits for an entry to be initialized and serves it. Of the entries that
+  // are ready, the earliest created is served first.
   HRESULT GetNextEntry(IReportContentEntry** entry);
 
 
@@ -57,8 +69,16 @@ class ReportContent : public IReportContent {
     return new RegistryExtractor();
   }
 
+  // An entry being initialized on a worker thread.
+  class PendingEntry;
+
+  // Starts initializing the queued entries on pool_.
+  void StartEntries();
+
   typedef std::list<ReportEntryWithInit*> ReportEntryContainer;
   ReportEntryContainer entry_queue_;
+  std::vector<PendingEntry*> pending_entries_;
+  scoped_ptr<base::DelegateSimpleThreadPool> pool_;
   scoped_ptr<ReportEntryWithInit> current_entry_;
 };
 
@@ -52,6 +52,7 @@ const wchar_t kDefaultBaloonText[] = L"Sawdust has started and is now "
     L"collecting log data.";
 const wchar_t kActivityLogFmt[] = L"%s\nLogging program activity "
     L"(started %d %s ago).";
+const wchar_t kLostEventsFmt[] = L"%s\n%u events lost.";
 const wchar_t kActivityUploadFmt[] = L"%s\n%s to %s.";
 const wchar_t kDoneUploadFmt[] = L"Log data has been %s to %s.%s";
 const wchar_t kUploadFailureFmt[] = L"The program encountered an error while "
@@ -432,15 +433,19 @@ void SawdustApplication::OrderlyShutdown(bool suppress_cleanup) {
     // stopped. Normally, they are taken over by the reporter. However, if the
     // reported never got invoked, they may be left over. We will remove them
     // here unless specifically told not to do so.
-    FilePath file_to_remove;
-    if (controller_.GetCompletedEventLogFileName(&file_to_remove) &&
-        file_util::PathExists(file_to_remove)) {
-      file_util::Delete(file_to_remove, false);
+    std::vector<FilePath> files_to_remove;
+    if (controller_.GetCompletedEventLogFiles(&files_to_remove)) {
+      for (size_t i = 0; i < files_to_remove.size(); ++i) {
+        if (file_util::PathExists(files_to_remove[i]))
+          file_util::Delete(files_to_remove[i], false);
+      }
     }
 
-    if (controller_.GetCompletedKernelEventLogFileName(&file_to_remove) &&
-        file_util::PathExists(file_to_remove)) {
-      file_util::Delete(file_to_remove, false);
+    if (controller_.GetCompletedKernelEventLogFiles(&files_to_remove)) {
+      for (size_t i = 0; i < files_to_remove.size(); ++i) {
+        if (file_util::PathExists(files_to_remove[i]))
+          file_util::Delete(files_to_remove[i], false);
+      }
     }
   }
 
@@ -570,7 +575,10 @@ void SawdustApplication::OnTooltipUpdateRequest() {
   bool remote = false;
   std::wstring upload_url;
   if (controller_.IsRunning()) {
-    // Logging.
+    // Logging. Rolling logs are kept within their budget as they go, and the
+    // sessions get more buffers if they lose events.
+    controller_.PruneRollingLogs();
+    controller_.TuneSessions();
     base::TimeDelta logtime = controller_.GetLoggingTimeSpan();
     const wchar_t* unit = L"minutes";
     int value = logtime.InMinutes();
@@ -584,6 +592,13 @@ void SawdustApplication::OnTooltipUpdateRequest() {
       _snwprintf_s(icon_data_.szTip, wsize, _TRUNCATE,
                    kActivityLogFmt, tooltip_buffer, value, unit);
       constructed = true;
+
+      ULONG lost_events = controller_.GetLostEventCount();
+      if (lost_events != 0) {
+        std::wstring activity(icon_data_.szTip);
+        _snwprintf_s(icon_data_.szTip, wsize, _TRUNCATE,
+                     kLostEventsFmt, activity.c_str(), lost_events);
+      }
     }
   } else if (upload_task_ != NULL &&
              configuration_object_.GetUploadPath(&upload_url, &remote)) {
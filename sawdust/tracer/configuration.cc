@@ -46,6 +46,9 @@ const char kChromeFile[] = "chrome_event_file";
 const char kKernelFileSize[] = "kernel_file_size";
 const char kChromeFileSize[] = "chrome_file_size";
 const char kHarvestEnvVars[] = "get_environment_strings";
+const char kRollingFileCount[] = "rolling_file_count";
+const char kReportMinutes[] = "report_minutes";
+const char kReduceLogs[] = "reduce_logs";
 
 const char kTargetKey[] = "target";
 const char kOnExitKey[] = "exit_handler";
@@ -70,6 +73,7 @@ const unsigned kDefaultFileSize = 15;
 const unsigned kMaxFileSize = 250;
 const bool kDefaultKernelTraceOn = true;
 const bool kDefaultEnvHarvesting = true;
+const unsigned kMaxRollingFileCount = 32;
 }  // namespace
 
 
@@ -85,6 +89,9 @@ TracerConfiguration::TracerConfiguration()
     : trace_kernel_on_(kDefaultKernelTraceOn),
       max_kernel_file_size_(kDefaultFileSize),
       max_chrome_file_size_(kDefaultFileSize),
+      rolling_file_count_(0),
+      report_minutes_(0),
+      reduce_logs_(false),
       exit_action_(REPORT_ASK),
       harvest_env_variables_(kDefaultEnvHarvesting) {
   if (named_levels_.empty()) {
@@ -338,6 +345,9 @@ bool TracerConfiguration::ExtractLogSettings(Value* log_node,
   trace_kernel_on_ = kDefaultKernelTraceOn;
   max_kernel_file_size_ = kDefaultFileSize;
   max_chrome_file_size_ = kDefaultFileSize;
+  rolling_file_count_ = 0;
+  report_minutes_ = 0;
+  reduce_logs_ = false;
   harvest_env_variables_ = kDefaultEnvHarvesting;
   std::string error_string;
   Value* param_value = NULL;
@@ -388,6 +398,33 @@ bool TracerConfiguration::ExtractLogSettings(Value* log_node,
       param_value->GetAsBoolean(&harvest_env_variables_);
   }
 
+  param_value = NULL;
+  if (SUCCEEDED(ExtractOptionalValue(options_dict, kRollingFileCount,
+                                     Value::TYPE_INTEGER, error_string_out,
+                                     &param_value)) && param_value != NULL) {
+    int raw_value = 0;
+    param_value->GetAsInteger(&raw_value);
+    if (raw_value > 0)
+      rolling_file_count_ = __min(raw_value, kMaxRollingFileCount);
+  }
+
+  param_value = NULL;
+  if (SUCCEEDED(ExtractOptionalValue(options_dict, kReportMinutes,
+                                     Value::TYPE_INTEGER, error_string_out,
+                                     &param_value)) && param_value != NULL) {
+    int raw_value = 0;
+    param_value->GetAsInteger(&raw_value);
+    if (raw_value > 0)
+      report_minutes_ = raw_value;
+  }
+
+  param_value = NULL;
+  if (SUCCEEDED(ExtractOptionalValue(options_dict, kReduceLogs,
+                                     Value::TYPE_BOOLEAN, error_string_out,
+                                     &param_value)) && param_value != NULL) {
+    param_value->GetAsBoolean(&reduce_logs_);
+  }
+
   return true;
 }
 
@@ -497,6 +534,9 @@ void TracerConfiguration::Clear() {
   trace_kernel_on_ = false;
   max_kernel_file_size_ = 0;
   max_chrome_file_size_ = 0;
+  rolling_file_count_ = 0;
+  report_minutes_ = 0;
+  reduce_logs_ = false;
 
   target_url_.clear();
   exit_action_ = REPORT_ASK;
@@ -24,6 +24,7 @@
 
 #include "base/file_path.h"
 #include "base/scoped_ptr.h"
+#include "base/time.h"
 #include "base/values.h"
 #include "base/version.h"
 #include "base/win/event_trace_provider.h"
@@ -85,6 +86,24 @@ class TracerConfiguration {
     return max_kernel_file_size_;
   }
 
+  // The number of files each log rolls over, 0 for a single circular file.
+  // Rolling logs still keep within the size caps above, split across files.
+  unsigned GetRollingFileCount() const {
+    return rolling_file_count_;
+  }
+
+  // How far back into rolling logs a report reaches, or a zero delta to
+  // report all of them.
+  base::TimeDelta GetReportTimeSpan() const {
+    return base::TimeDelta::FromMinutes(report_minutes_);
+  }
+
+  // Should the application log be reduced to a log archive before upload.
+  // The archive drops the trace buffers and collapses repeated messages.
+  bool ReduceLogs() const {
+    return reduce_logs_;
+  }
+
   // These functions yield a file name to use. There is no guarantee you will
   // get the same path next time you call, that may depend on other settings.
   bool GetLogFileName(FilePath* return_path) const;
@@ -178,6 +197,9 @@ class TracerConfiguration {
   bool trace_kernel_on_;
   unsigned max_kernel_file_size_;
   unsigned max_chrome_file_size_;
+  unsigned rolling_file_count_;
+  unsigned report_minutes_;
+  bool reduce_logs_;
 
   bool harvest_env_variables_;
 
@@ -87,6 +87,9 @@ class TracerConfigurationTest : public testing::Test {
     ADD_TO_MAP(verification_map_, IsKernelLoggingEnabled);
     ADD_TO_MAP(verification_map_, GetLogFileSizeCapMb);
     ADD_TO_MAP(verification_map_, GetKernelLogFileSizeCapMb);
+    ADD_TO_MAP(verification_map_, GetRollingFileCount);
+    ADD_TO_MAP(verification_map_, GetReportTimeSpan);
+    ADD_TO_MAP(verification_map_, ReduceLogs);
     ADD_TO_MAP(verification_map_, GetLogFileName);
     ADD_TO_MAP(verification_map_, GetKernelLogFileName);
     ADD_TO_MAP(verification_map_, GetTracedApplication);
@@ -269,6 +272,23 @@ class TracerConfigurationTest : public testing::Test {
         &TracerConfiguration::GetKernelLogFileSizeCapMb, test_value));
   }
 
+  void VerifyGetRollingFileCount(const Value& test_value) const {
+    ASSERT_TRUE(CheckResultEqualDirect(tested_object_.get(),
+        &TracerConfiguration::GetRollingFileCount, test_value));
+  }
+
+  void VerifyGetReportTimeSpan(const Value& test_value) const {
+    // The time span is declared in minutes.
+    int test_minutes = 0;
+    ASSERT_TRUE(test_value.GetAsInteger(&test_minutes));
+    ASSERT_EQ(test_minutes, tested_object_->GetReportTimeSpan().InMinutes());
+  }
+
+  void VerifyReduceLogs(const Value& test_value) const {
+    ASSERT_TRUE(CheckResultEqualDirect(tested_object_.get(),
+        &TracerConfiguration::ReduceLogs, test_value));
+  }
+
   void VerifyGetLogFileName(const Value& test_value) const {
     ASSERT_TRUE(CheckResultEqualIndirect(tested_object_.get(),
         &TracerConfiguration::GetLogFileName, test_value));
@@ -15,9 +15,126 @@
 // Controller for ETW events (a wrapper around base implementation).
 #include "sawdust/tracer/controller.h"
 
+#include <algorithm>
+#include <map>
+#include <set>
+
+#include "base/file_util.h"
 #include "base/logging.h"
+#include "base/string_number_conversions.h"
+#include "base/threading/simple_thread.h"
 #include "sawdust/tracer/com_utils.h"
 
+namespace {
+
+// ETW replaces this with the sequence number of each file of a rolling log.
+const wchar_t kRollingFileNumber[] = L"%d";
+
+// The most memory the buffers of each session may grow to.
+const ULONG kMaxSessionBufferMemoryKb = 8 * 1024;
+
+// Sets up the file mode of a session to a single circular file of
+// |size_cap_mb|, or to |file_count| rolling files within the same budget.
+void SetLogFileMode(unsigned size_cap_mb, unsigned file_count,
+                    EVENT_TRACE_PROPERTIES* properties) {
+  DCHECK(properties != NULL);
+  if (file_count == 0) {
+    // Circular log, and get the entire space right away to avoid any trouble.
+    properties->LogFileMode = EVENT_TRACE_FILE_MODE_CIRCULAR |
+                              EVENT_TRACE_FILE_MODE_PREALLOCATE;
+    properties->MaximumFileSize = size_cap_mb;
+  } else {
+    // A new file whenever the current one is full. The oldest files are
+    // pruned by the controller.
+    properties->LogFileMode = EVENT_TRACE_FILE_MODE_NEWFILE;
+    properties->MaximumFileSize = std::max(1U, size_cap_mb / file_count);
+  }
+}
+
+// Lists the files of the rolling log |pattern| in |files|, oldest first.
+// Files last written before |not_before| are left out, unless it is null.
+void ListRollingLogFiles(const FilePath& pattern,
+                         base::Time not_before,
+                         std::vector<FilePath>* files) {
+  DCHECK(files != NULL);
+  const std::wstring name = pattern.BaseName().value();
+  size_t number_pos = name.find(kRollingFileNumber);
+  DCHECK_NE(std::wstring::npos, number_pos);
+  std::wstring prefix = name.substr(0, number_pos);
+  std::wstring suffix = name.substr(number_pos + wcslen(kRollingFileNumber));
+
+  // The files are ordered by their sequence number rather than by time, as
+  // the file being written may not have been flushed yet.
+  typedef std::map<int, FilePath> NumberedFiles;
+  NumberedFiles numbered_files;
+  file_util::FileEnumerator enumerator(pattern.DirName(), false,
+                                       file_util::FileEnumerator::FILES,
+                                       prefix + L"*" + suffix);
+  for (FilePath file = enumerator.Next(); !file.empty();
+       file = enumerator.Next()) {
+    file_util::FileEnumerator::FindInfo info = {};
+    enumerator.GetFindInfo(&info);
+    if (!not_before.is_null() &&
+        base::Time::FromFileTime(info.ftLastWriteTime) < not_before) {
+      continue;
+    }
+
+    const std::wstring& file_name = file.BaseName().value();
+    if (file_name.size() <= prefix.size() + suffix.size())
+      continue;
+    int number = 0;
+    if (base::StringToInt(file_name.substr(prefix.size(), file_name.size() -
+                                           prefix.size() - suffix.size()),
+                          &number)) {
+      numbered_files[number] = file;
+    }
+  }
+
+  for (NumberedFiles::const_iterator it = numbered_files.begin();
+       it != numbered_files.end(); ++it) {
+    files->push_back(it->second);
+  }
+}
+
+// Deletes the files of the rolling log |pattern| beyond the newest
+// |keep_count|, and these last written before |not_before| unless it is null.
+void DeleteRollingLogFiles(const FilePath& pattern,
+                           size_t keep_count,
+                           base::Time not_before) {
+  std::vector<FilePath> recent_files;
+  ListRollingLogFiles(pattern, not_before, &recent_files);
+  std::set<std::wstring> kept_files;
+  for (size_t i = recent_files.size() - std::min(keep_count,
+                                                 recent_files.size());
+       i < recent_files.size(); ++i) {
+    kept_files.insert(recent_files[i].value());
+  }
+
+  std::vector<FilePath> all_files;
+  ListRollingLogFiles(pattern, base::Time(), &all_files);
+  for (size_t i = 0; i < all_files.size(); ++i) {
+    if (kept_files.find(all_files[i].value()) == kept_files.end() &&
+        !file_util::Delete(all_files[i], false)) {
+      LOG(WARNING) << "Failed to delete rolling log file "
+          << all_files[i].value();
+    }
+  }
+}
+
+// Yields the files of the completed |event_log|, expanding it if it is the
+// pattern of a rolling log.
+void ExpandCompletedLog(const FilePath& event_log,
+                        std::vector<FilePath>* event_logs) {
+  DCHECK(event_logs != NULL);
+  event_logs->clear();
+  if (event_log.value().find(kRollingFileNumber) == std::wstring::npos)
+    event_logs->push_back(event_log);
+  else
+    ListRollingLogFiles(event_log, base::Time(), event_logs);
+}
+
+}  // namespace
+
 const wchar_t TracerController::kSawdustTraceSessionName[] =
     L"Sawdust logging session";
 
@@ -45,6 +162,26 @@ HRESULT TracerController::Start(const TracerConfiguration& config) {
     return E_FAIL;
   }
 
+  // In rolling mode, ETW numbers the files after the configured paths.
+  rolling_file_count_ = config.GetRollingFileCount();
+  report_time_span_ = config.GetReportTimeSpan();
+  rolling_chrome_pattern_.clear();
+  rolling_kernel_pattern_.clear();
+  if (rolling_file_count_ != 0) {
+    // The configured files themselves are never written to. Remove them, as
+    // they may have been created as placeholders.
+    file_util::Delete(log_path, false);
+    log_path = log_path.InsertBeforeExtension(
+        std::wstring(L".") + kRollingFileNumber);
+    rolling_chrome_pattern_ = log_path;
+    if (!kernel_path.empty()) {
+      file_util::Delete(kernel_path, false);
+      kernel_path = kernel_path.InsertBeforeExtension(
+          std::wstring(L".") + kRollingFileNumber);
+      rolling_kernel_pattern_ = kernel_path;
+    }
+  }
+
   HRESULT hr = S_OK;
   {
     base::win::EtwTraceProperties trace_definition;
@@ -52,11 +189,7 @@ HRESULT TracerController::Start(const TracerConfiguration& config) {
     EVENT_TRACE_PROPERTIES* p = trace_definition.get();
     p->Wnode.ClientContext = 1;  // QPC timer accuracy.
 
-    // Circular log, and get the entire space right away to avoid any trouble.
-    p->LogFileMode = EVENT_TRACE_FILE_MODE_CIRCULAR |
-                    EVENT_TRACE_FILE_MODE_PREALLOCATE;
-
-    p->MaximumFileSize = config.GetLogFileSizeCapMb();
+    SetLogFileMode(config.GetLogFileSizeCapMb(), rolling_file_count_, p);
     p->FlushTimer = 30;  // 30 seconds flush lag.
     hr = StartLogging(&log_controller_, &trace_definition,
                       kSawdustTraceSessionName);
@@ -68,14 +201,20 @@ HRESULT TracerController::Start(const TracerConfiguration& config) {
     return hr;
   }
 
+  // The flush lag of the sessions is deliberate, only their buffers are
+  // tuned.
+  EtwSessionTuner::Options tuner_options;
+  tuner_options.max_buffer_memory_kb = kMaxSessionBufferMemoryKb;
+  log_tuner_.reset(new EtwSessionTuner(kSawdustTraceSessionName,
+                                       tuner_options));
+
   if (config.IsKernelLoggingEnabled()) {
     base::win::EtwTraceProperties trace_definition;
     trace_definition.SetLoggerFileName(kernel_path.value().c_str());
     EVENT_TRACE_PROPERTIES* p = trace_definition.get();
     p->Wnode.Guid = SystemTraceControlGuid;
-    p->LogFileMode = EVENT_TRACE_FILE_MODE_CIRCULAR |
-                     EVENT_TRACE_FILE_MODE_PREALLOCATE;
-    p->MaximumFileSize = config.GetKernelLogFileSizeCapMb();
+    SetLogFileMode(config.GetKernelLogFileSizeCapMb(), rolling_file_count_,
+                   p);
     // Get image load and process events.
     p->EnableFlags = EVENT_TRACE_FLAG_IMAGE_LOAD | EVENT_TRACE_FLAG_PROCESS;
     p->FlushTimer = 1;  // flush every second.
@@ -88,6 +227,8 @@ HRESULT TracerController::Start(const TracerConfiguration& config) {
           kernel_path.value().c_str();
       return hr;
     }
+    kernel_tuner_.reset(new EtwSessionTuner(KERNEL_LOGGER_NAME,
+                                            tuner_options));
   }
 
   initialized_providers_.clear();
@@ -97,12 +238,98 @@ HRESULT TracerController::Start(const TracerConfiguration& config) {
   return initialized_providers_.empty() ? S_FALSE : hr;
 }
 
+void TracerController::PruneRollingLogs() {
+  base::AutoLock lock(start_stop_lock_);
+
+  if (!rolling_chrome_pattern_.empty() && log_controller_.session() != NULL) {
+    DeleteRollingLogFiles(rolling_chrome_pattern_, rolling_file_count_,
+                          base::Time());
+  }
+  if (!rolling_kernel_pattern_.empty() &&
+      kernel_controller_.session() != NULL) {
+    DeleteRollingLogFiles(rolling_kernel_pattern_, rolling_file_count_,
+                          base::Time());
+  }
+}
+
+void TracerController::TuneSessions() {
+  base::AutoLock lock(start_stop_lock_);
+
+  // Failures are benign, the sessions keep their current settings.
+  if (log_tuner_.get() != NULL)
+    log_tuner_->Tune();
+  if (kernel_tuner_.get() != NULL)
+    kernel_tuner_->Tune();
+}
+
+ULONG TracerController::GetLostEventCount() const {
+  base::AutoLock lock(start_stop_lock_);
+
+  ULONG lost = 0;
+  if (log_tuner_.get() != NULL)
+    lost += log_tuner_->events_lost() + log_tuner_->buffers_lost();
+  if (kernel_tuner_.get() != NULL)
+    lost += kernel_tuner_->events_lost() + kernel_tuner_->buffers_lost();
+  return lost;
+}
+
+class TracerController::KernelLogStopper
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  KernelLogStopper(TracerController* controller, FilePath* log_path)
+      : controller_(controller), log_path_(log_path) {
+    DCHECK(controller != NULL);
+    DCHECK(log_path != NULL);
+  }
+
+  virtual void Run() {
+    controller_->StopKernelLogging(log_path_);
+  }
+
+ private:
+  TracerController* controller_;
+  FilePath* log_path_;
+
+  DISALLOW_COPY_AND_ASSIGN(KernelLogStopper);
+};
+
 HRESULT TracerController::Stop() {
   base::AutoLock lock(start_stop_lock_);
 
-  StopKernelLogging(&acquired_kernel_log_);
+  log_tuner_.reset();
+  kernel_tuner_.reset();
+
+  // Stopping a session waits for its buffers to be flushed to disk, so when
+  // there are two sessions the kernel log is stopped on a worker thread while
+  // the application log is stopped here.
+  HRESULT hr = S_OK;
+  if (kernel_controller_.session() != NULL) {
+    KernelLogStopper kernel_log_stopper(this, &acquired_kernel_log_);
+    base::DelegateSimpleThread kernel_log_thread(&kernel_log_stopper,
+                                                 "Kernel log stop");
+    kernel_log_thread.Start();
+    hr = StopLogging(&initialized_providers_, &acquired_chrome_log_);
+    kernel_log_thread.Join();
+  } else {
+    StopKernelLogging(&acquired_kernel_log_);
+    hr = StopLogging(&initialized_providers_, &acquired_chrome_log_);
+  }
 
-  HRESULT hr = StopLogging(&initialized_providers_, &acquired_chrome_log_);
+  // Rolling logs are acquired as the pattern of their file names. Only the
+  // files that fit in the file count and the report time span are kept.
+  base::Time not_before;
+  if (report_time_span_ > base::TimeDelta())
+    not_before = base::Time::Now() - report_time_span_;
+  if (!rolling_kernel_pattern_.empty() && !acquired_kernel_log_.empty()) {
+    acquired_kernel_log_ = rolling_kernel_pattern_;
+    DeleteRollingLogFiles(rolling_kernel_pattern_, rolling_file_count_,
+                          not_before);
+  }
+  if (!rolling_chrome_pattern_.empty() && !acquired_chrome_log_.empty()) {
+    acquired_chrome_log_ = rolling_chrome_pattern_;
+    DeleteRollingLogFiles(rolling_chrome_pattern_, rolling_file_count_,
+                          not_before);
+  }
 
   if (FAILED(hr))
     return hr;
@@ -141,6 +368,28 @@ bool TracerController::GetCompletedKernelEventLogFileName(
   return true;
 }
 
+bool TracerController::GetCompletedEventLogFiles(
+    std::vector<FilePath>* event_logs) const {
+  DCHECK(event_logs != NULL);
+  FilePath event_log;
+  if (!GetCompletedEventLogFileName(&event_log))
+    return false;
+
+  ExpandCompletedLog(event_log, event_logs);
+  return !event_logs->empty();
+}
+
+bool TracerController::GetCompletedKernelEventLogFiles(
+    std::vector<FilePath>* event_logs) const {
+  DCHECK(event_logs != NULL);
+  FilePath event_log;
+  if (!GetCompletedKernelEventLogFileName(&event_log))
+    return false;
+
+  ExpandCompletedLog(event_log, event_logs);
+  return !event_logs->empty();
+}
+
 bool TracerController::GetCurrentEventLogFileName(FilePath* event_log) const {
   return RetrieveCurrentLogFileName(log_controller_, kSawdustTraceSessionName,
                                     event_log);
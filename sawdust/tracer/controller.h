@@ -20,10 +20,12 @@
 #include <vector>
 
 #include "base/file_path.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/synchronization/lock.h"
 #include "base/time.h"
 #include "base/win/event_trace_controller.h"
 
+#include "sawbuck/common/etw_session_tuner.h"
 #include "sawdust/tracer/configuration.h"
 
 // The controller (you really want one at a time) starts and stops logging
@@ -34,7 +36,7 @@ class TracerController {
   static const wchar_t kSawdustTraceSessionName[];
   static const int kMinimalLogAgeInSeconds = 180;
 
-  TracerController() { }
+  TracerController() : rolling_file_count_(0) { }
   virtual ~TracerController() { }
 
   // Commences logging as defined in settings. It is a breach of contract to
@@ -42,6 +44,18 @@ class TracerController {
   // create disk files as defined in config.
   HRESULT Start(const TracerConfiguration& config);
 
+  // In rolling mode, removes the oldest files of the running sessions, to keep
+  // within the configured file count. This should be called periodically.
+  void PruneRollingLogs();
+
+  // Grows the buffers of the running sessions when they lose events, within
+  // a memory cap. This should be called periodically.
+  void TuneSessions();
+
+  // Returns the number of events the running sessions lost as of the last
+  // call to TuneSessions.
+  ULONG GetLostEventCount() const;
+
   // Stops the current logging session. If successful, paths of acquired logs
   // can be retrieved usign GetComplete* functions. These files are left on the
   // disk (the controller doesn't own them).
@@ -61,7 +75,16 @@ class TracerController {
   virtual bool GetCompletedEventLogFileName(FilePath* event_log) const;
   virtual bool GetCompletedKernelEventLogFileName(FilePath* event_log) const;
 
+  // Same as above, but in rolling mode expand into the files of the log that
+  // are still around, oldest first. Otherwise yield the single log file.
+  bool GetCompletedEventLogFiles(std::vector<FilePath>* event_logs) const;
+  bool GetCompletedKernelEventLogFiles(
+      std::vector<FilePath>* event_logs) const;
+
  private:
+  // Stops the kernel log on a worker thread.
+  class KernelLogStopper;
+
   // A call to the Start method of the controller. Intended as a test seam only.
   virtual HRESULT StartLogging(base::win::EtwTraceController* controller,
                                base::win::EtwTraceProperties* properties,
@@ -104,6 +127,10 @@ class TracerController {
   // Controller for the kernel logging session.
   base::win::EtwTraceController kernel_controller_;
 
+  // Tune the buffers of the logging sessions, while they run.
+  scoped_ptr<EtwSessionTuner> log_tuner_;
+  scoped_ptr<EtwSessionTuner> kernel_tuner_;
+
   // The list of providers currently associated with log_controller.
   TracerConfiguration::ProviderDefinitions initialized_providers_;
 
@@ -112,6 +139,14 @@ class TracerController {
   FilePath acquired_kernel_log_;
   FilePath acquired_chrome_log_;
 
+  // In rolling mode, the number of files kept by each log and the patterns of
+  // their file names. The patterns are empty otherwise.
+  unsigned rolling_file_count_;
+  FilePath rolling_chrome_pattern_;
+  FilePath rolling_kernel_pattern_;
+  // How far back into rolling logs to keep once logging stops.
+  base::TimeDelta report_time_span_;
+
   base::Time mru_start_point_;
   mutable base::Lock start_stop_lock_;
 
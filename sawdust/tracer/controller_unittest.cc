@@ -16,10 +16,12 @@
 #include <map>
 #include <string>
 
+#include "base/file_util.h"
 #include "base/json/json_writer.h"
 #include "base/logging.h"
 #include "base/scoped_ptr.h"
 #include "base/scoped_temp_dir.h"
+#include "base/stringprintf.h"
 #include "base/values.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -85,6 +87,8 @@ class TracerControllerTest : public testing::Test {
                                 const wchar_t* logger) {
     intercepted_logger_paths_.insert(
         PathMapType::value_type(logger, properties->GetLoggerFileName()));
+    intercepted_file_modes_[logger] = properties->get()->LogFileMode;
+    intercepted_file_sizes_[logger] = properties->get()->MaximumFileSize;
     return S_OK;
   }
 
@@ -98,6 +102,8 @@ class TracerControllerTest : public testing::Test {
   scoped_ptr<Value> configurations_;
   ScopedTempDir temp_dir_;
   PathMapType intercepted_logger_paths_;
+  std::map<std::wstring, ULONG> intercepted_file_modes_;
+  std::map<std::wstring, ULONG> intercepted_file_sizes_;
   TracerConfiguration::ProviderDefinitions intercepted_providers_;
 };
 
@@ -232,4 +238,54 @@ TEST_F(TracerControllerTest, TestWithKernelAndPaths) {
   ASSERT_EQ(intercepted_providers_.size(), 1);
 }
 
+TEST_F(TracerControllerTest, TestWithRollingLogs) {
+  TracerConfiguration config;
+  ASSERT_NO_FATAL_FAILURE(RetrieveConfiguration("rolling", &config));
+
+  // Expectations: the application log rolls over 4 numbered files, which
+  // share its 100MB budget.
+  MockTracerController controller;
+  EXPECT_CALL(controller, VerifyAndStopIfRunning(_)).
+      WillRepeatedly(Return(true));
+  EXPECT_CALL(controller, StartLogging(_, _,
+      StrEq(TracerController::kSawdustTraceSessionName))).
+          WillOnce(Invoke(this, &TracerControllerTest::InterceptStartLogging));
+  EXPECT_CALL(controller, EnableProviders(_, _)).
+      WillOnce(Invoke(this, &TracerControllerTest::InterceptEnableProviders));
+
+  ASSERT_HRESULT_SUCCEEDED(controller.Start(config));
+
+  const std::wstring session(TracerController::kSawdustTraceSessionName);
+  ASSERT_FALSE(intercepted_logger_paths_.find(session) ==
+               intercepted_logger_paths_.end());
+  FilePath pattern(intercepted_logger_paths_[session]);
+  ASSERT_EQ(temp_dir_.path().Append(L"chrome_events.%d.etl"), pattern);
+  ASSERT_EQ(EVENT_TRACE_FILE_MODE_NEWFILE, intercepted_file_modes_[session]);
+  ASSERT_EQ(25, intercepted_file_sizes_[session]);
+
+  // Pretend ETW went through 6 files, only the last 4 of which are kept.
+  std::vector<FilePath> rolled_files;
+  for (int i = 1; i <= 6; ++i) {
+    FilePath rolled_file = temp_dir_.path().Append(
+        base::StringPrintf(L"chrome_events.%d.etl", i));
+    ASSERT_EQ(1, file_util::WriteFile(rolled_file, "x", 1));
+    rolled_files.push_back(rolled_file);
+  }
+
+  EXPECT_CALL(controller, StopKernelLogging(_)).WillOnce(Return(false));
+  EXPECT_CALL(controller, StopLogging(_, _)).WillOnce(DoAll(
+      SetArgumentPointee<0>(TracerConfiguration::ProviderDefinitions()),
+      SetArgumentPointee<1>(pattern),
+      Return(S_OK)));
+  ASSERT_HRESULT_SUCCEEDED(controller.Stop());
+
+  std::vector<FilePath> app_files;
+  ASSERT_TRUE(controller.GetCompletedEventLogFiles(&app_files));
+  ASSERT_EQ(4, app_files.size());
+  for (size_t i = 0; i < app_files.size(); ++i)
+    ASSERT_EQ(rolled_files[i + 2], app_files[i]);
+  ASSERT_FALSE(file_util::PathExists(rolled_files[0]));
+  ASSERT_FALSE(file_util::PathExists(rolled_files[1]));
+}
+
 }  // namespace
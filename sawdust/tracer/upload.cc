@@ -20,9 +20,15 @@
 #include <msxml.h>
 #include <wininet.h>  // For win32 http error code.
 
+#include <deque>
+
 #include "base/file_util.h"
 #include "base/logging.h"
 #include "base/string_number_conversions.h"
+#include "base/sys_info.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/simple_thread.h"
+#include "third_party/zlib/zlib.h"
 #include "third_party/zlib/contrib/minizip/zip.h"
 #include "third_party/zlib/contrib/minizip/iowin32.h"
 
@@ -38,7 +44,84 @@ typedef struct {
   int error;
 } WIN32FILE_IOWIN;
 
-const unsigned kZipBufferSize = 8192;
+// The size of the chunks entries are read and deflated in.
+const size_t kDeflateChunkSize = 256 * 1024;
+
+// The number of chunks read ahead of the one being written, per worker.
+const size_t kChunksInFlightPerWorker = 2;
+
+// A chunk of an entry, deflated on a worker thread. Each chunk is deflated
+// on its own and ends on a byte boundary (Z_SYNC_FLUSH), so that the chunks
+// of an entry concatenate to a single raw deflate stream. Only the last chunk
+// of an entry finishes the stream. This costs a little in compression ratio,
+// as chunks don't share their dictionary.
+class DeflateChunk : public base::DelegateSimpleThread::Delegate {
+ public:
+  DeflateChunk()
+      : input_size_(0), last_(false), crc_(0), result_(Z_OK),
+        done_(true, false) {
+  }
+
+  // Reads the next chunk of |data|. Returns false if the stream is bad.
+  bool Read(std::istream* data) {
+    DCHECK(data != NULL);
+    input_.resize(kDeflateChunkSize);
+    std::streamsize bytes_read = data->read(&input_[0], input_.size()).gcount();
+    input_.resize(static_cast<size_t>(bytes_read));
+    input_size_ = input_.size();
+    last_ = data->eof();
+    return !data->bad();
+  }
+
+  virtual void Run() {
+    crc_ = crc32(0L, reinterpret_cast<const Bytef*>(input_.data()),
+                 input_.size());
+
+    z_stream stream = {};
+    result_ = deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                           -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    if (result_ == Z_OK) {
+      // Leave room for the sync flush marker.
+      output_.resize(deflateBound(&stream, input_.size()) + 16);
+      stream.next_in = reinterpret_cast<Bytef*>(
+          const_cast<char*>(input_.data()));
+      stream.avail_in = input_.size();
+      stream.next_out = reinterpret_cast<Bytef*>(&output_[0]);
+      stream.avail_out = output_.size();
+      result_ = deflate(&stream, last_ ? Z_FINISH : Z_SYNC_FLUSH);
+      if (result_ == Z_STREAM_END || (!last_ && result_ == Z_OK &&
+                                      stream.avail_in == 0)) {
+        result_ = Z_OK;
+      } else if (result_ == Z_OK) {
+        result_ = Z_BUF_ERROR;
+      }
+      output_.resize(stream.total_out);
+      deflateEnd(&stream);
+    }
+
+    // Release the input early, it's no longer needed.
+    std::string().swap(input_);
+    done_.Signal();
+  }
+
+  void Wait() { done_.Wait(); }
+
+  size_t input_size() const { return input_size_; }
+  const std::string& output() const { return output_; }
+  uLong crc() const { return crc_; }
+  bool succeeded() const { return result_ == Z_OK; }
+
+ private:
+  std::string input_;
+  size_t input_size_;
+  std::string output_;
+  bool last_;
+  uLong crc_;
+  int result_;
+  base::WaitableEvent done_;
+
+  DISALLOW_COPY_AND_ASSIGN(DeflateChunk);
+};
 
 // A custom zip file-open function (see zipOpen2 in minizip/zip.h). Note that
 // the allocated structure is owned by the caller (minizip library, that is).
@@ -144,6 +227,10 @@ HRESULT ReportUploader::ZipContent(IReportContent* content) {
     return false;
   }
 
+  base::DelegateSimpleThreadPool pool("Report compression",
+                                     base::SysInfo::NumberOfProcessors());
+  pool.Start();
+
   IReportContentEntry* entry = NULL;
   HRESULT hr = content->GetNextEntry(&entry);
 
@@ -151,7 +238,7 @@ HRESULT ReportUploader::ZipContent(IReportContent* content) {
     if (abort_)
       hr = E_ABORT;
     else
-      hr = WriteEntryIntoZip(archive_handle, entry);
+      hr = WriteEntryIntoZip(archive_handle, entry, &pool);
 
     if (SUCCEEDED(hr)) {
       entry->MarkCompleted();
@@ -159,6 +246,8 @@ HRESULT ReportUploader::ZipContent(IReportContent* content) {
     }
   }
 
+  pool.JoinAll();
+
   // Regardless the result, close the archive.
   int close_file_code = zipClose(archive_handle, NULL);
   if (close_file_code != ZIP_OK) {
@@ -197,21 +286,25 @@ bool ReportUploader::GetArchivePath(FilePath* archive_path) const {
 }
 
 
-HRESULT ReportUploader::WriteEntryIntoZip(void* zip_vhandle,
-                                          IReportContentEntry* entry) {
+HRESULT ReportUploader::WriteEntryIntoZip(
+    void* zip_vhandle, IReportContentEntry* entry,
+    base::DelegateSimpleThreadPool* pool) {
+  DCHECK(pool != NULL);
   // The purpose of shenanigans with the parameter type here is to avoid
   // including a third_party header into upload.h.
   zipFile zip_file = zip_vhandle;
-  if (ZIP_OK != zipOpenNewFileInZip(zip_file,
-                                    entry->Title(),
-                                    NULL,  // No file info.
-                                    NULL,  // No extrafield_local.
-                                    0u,    // Size of extrafield_local (none).
-                                    NULL,  // No extrafield_global.
-                                    0u,    // Size of extrafield_global (none).
-                                    NULL,  // No comment.
-                                    Z_DEFLATED,  // Compression method.
-                                    Z_DEFAULT_COMPRESSION)) {  // Level.
+  // The chunks are deflated on our own, so the entry is written raw.
+  if (ZIP_OK != zipOpenNewFileInZip2(zip_file,
+                                     entry->Title(),
+                                     NULL,  // No file info.
+                                     NULL,  // No extrafield_local.
+                                     0u,    // Size of extrafield_local.
+                                     NULL,  // No extrafield_global.
+                                     0u,    // Size of extrafield_global.
+                                     NULL,  // No comment.
+                                     Z_DEFLATED,  // Compression method.
+                                     Z_DEFAULT_COMPRESSION,  // Level.
+                                     1)) {  // Raw.
     LOG(ERROR) << "Could not open zip file entry " << entry->Title();
     return E_FAIL;
   }
@@ -220,32 +313,60 @@ HRESULT ReportUploader::WriteEntryIntoZip(void* zip_vhandle,
   // Write the content using provided stream.
   std::istream& data = entry->Data();
 
-  char buffer[kZipBufferSize];
-
-  bool keep_zipping = true;
-  do {
-    std::streamsize bytes_read = data.read(buffer, sizeof(buffer)).gcount();
+  // The chunks being deflated, in the order they are to be written. Reading
+  // stops once enough chunks are in flight to keep all the workers busy.
+  const size_t max_chunks_in_flight =
+      kChunksInFlightPerWorker * base::SysInfo::NumberOfProcessors();
+  std::deque<DeflateChunk*> chunks;
+  bool keep_reading = true;
+  uLong crc = crc32(0L, Z_NULL, 0);
+  uLong uncompressed_size = 0;
+
+  while (keep_reading || !chunks.empty()) {
+    if (keep_reading && chunks.size() < max_chunks_in_flight) {
+      DeflateChunk* chunk = new DeflateChunk();
+      if (!chunk->Read(&data)) {
+        LOG(ERROR) << "Reading from source stream " << entry->Title()
+            << " failed.";
+        hr = E_FAIL;
+        keep_reading = false;
+        delete chunk;
+      } else if (abort_) {
+        hr = E_ABORT;
+        keep_reading = false;
+        delete chunk;
+      } else {
+        keep_reading = !data.eof();
+        chunks.push_back(chunk);
+        pool->AddWork(chunk, 1);
+      }
+      continue;
+    }
 
-    if (data.bad()) {
-      LOG(ERROR) << "Reading from source stream " << entry->Title()
-          << " failed.";
-      hr = E_FAIL;
-      keep_zipping = false;
-    } else if (abort_) {
-      keep_zipping = false;
-      hr = E_ABORT;
-    } else {
-      if (ZIP_OK != zipWriteInFileInZip(zip_file, buffer, bytes_read)) {
+    // Write out the oldest chunk. On failure, the remaining chunks are still
+    // waited for, as the workers reference them.
+    DeflateChunk* chunk = chunks.front();
+    chunks.pop_front();
+    chunk->Wait();
+    if (SUCCEEDED(hr)) {
+      if (!chunk->succeeded()) {
+        LOG(ERROR) << "Could not compress data for path " << entry->Title();
+        hr = E_FAIL;
+      } else if (ZIP_OK != zipWriteInFileInZip(zip_file,
+                                               chunk->output().data(),
+                                               chunk->output().size())) {
         LOG(ERROR) << "Could not write data to zip for path " << entry->Title();
         hr = E_FAIL;
-        keep_zipping = false;
       } else {
-        keep_zipping = !data.eof();
+        crc = crc32_combine(crc, chunk->crc(), chunk->input_size());
+        uncompressed_size += chunk->input_size();
       }
+      keep_reading = keep_reading && SUCCEEDED(hr);
     }
-  } while (keep_zipping);
+    delete chunk;
+  }
 
-  if (ZIP_OK != zipCloseFileInZip(zip_file)) {
+  if (ZIP_OK != zipCloseFileInZipRaw(zip_file, uncompressed_size, crc)) {
     LOG(ERROR) << "Could not close zip file entry " << entry->Title();
     return E_FAIL;
   }
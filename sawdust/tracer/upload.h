@@ -22,6 +22,10 @@
 
 #include "base/file_path.h"
 
+namespace base {
+class DelegateSimpleThreadPool;
+}  // namespace base
+
 // A single entry corresponding to a file in the target archive. The purpose of
 // istream masquerade is to have consistent interface to binary files (logs) and
 // whatever other content we might want to write. These streams are never used
@@ -76,7 +80,8 @@ class ReportUploader {
   void SignalAbort();
 
  protected:
-  // Write the entire |content| into zip file at temp_archive_path_.
+  // Write the entire |content| into zip file at temp_archive_path_. The
+  // entries are deflated in chunks on a pool of worker threads.
   HRESULT ZipContent(IReportContent* content);
 
   // Remove the temporary archive from the local drive.
@@ -91,7 +96,10 @@ class ReportUploader {
   virtual bool MakeTemporaryPath(FilePath* tmp_file_path) const;
 
  private:
-  HRESULT WriteEntryIntoZip(void* zip_handle, IReportContentEntry* entry);
+  // Deflates |entry| chunk by chunk on |pool| and writes the compressed chunks
+  // into the zip, in order, as they complete.
+  HRESULT WriteEntryIntoZip(void* zip_handle, IReportContentEntry* entry,
+                            base::DelegateSimpleThreadPool* pool);
 
   std::wstring uri_target_;  // Upload target path.
   bool remote_upload_;  // Is uri_target_ a HTTP location or a local path.
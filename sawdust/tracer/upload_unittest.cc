@@ -24,6 +24,7 @@
 #include "base/file_util.h"
 #include "base/logging.h"
 #include "base/scoped_temp_dir.h"
+#include "base/string_number_conversions.h"
 #include "base/utf_string_conversions.h"
 #include "gtest/gtest.h"
 #include "gmock/gmock.h"
@@ -63,6 +64,23 @@ class ScopedZipWrap {
       return UNZ_OK == unzLocateFile(file_, path, 0);
     return false;
   }
+
+  bool ReadFile(const char* path, std::string* content) {
+    if (file_ == NULL || UNZ_OK != unzLocateFile(file_, path, 0) ||
+        UNZ_OK != unzOpenCurrentFile(file_)) {
+      return false;
+    }
+    content->clear();
+    char buffer[4096];
+    int bytes_read = 0;
+    while ((bytes_read = unzReadCurrentFile(file_, buffer,
+                                            sizeof(buffer))) > 0) {
+      content->append(buffer, bytes_read);
+    }
+    // Closing the file checks its CRC.
+    return UNZ_OK == unzCloseCurrentFile(file_) && bytes_read == 0;
+  }
+
  private:
   unzFile file_;
 };
@@ -290,6 +308,38 @@ TEST_F(ReportUploadTest, CompressionToLocal) {
   ASSERT_TRUE(verified_zip.Close());
 }
 
+// Entries larger than a compression chunk are split across the workers, and
+// must come back out of the archive intact.
+TEST_F(ReportUploadTest, CompressionOfLargeEntries) {
+  FilePath file_path =
+      temp_dir_.path().AppendASCII("CompressionOfLargeEntries.zip");
+
+  TestingReportUploader uploader(file_path.value(), true);
+
+  std::string large_text;
+  for (int i = 0; large_text.size() < 3 * 1024 * 1024 + 17; ++i)
+    large_text.append(base::IntToString(i * i)).append(" ");
+
+  TestContentContainer data_feed;
+  data_feed.Add(new ContentFromText("empty.txt", ""));
+  data_feed.Add(new ContentFromText("large.txt", large_text));
+  data_feed.Add(new ContentFromText("data.txt",
+      "asjkdjkasdjka lsdjas ljklasdjkl sjklddjsk"));
+
+  ASSERT_HRESULT_SUCCEEDED(uploader.Upload(&data_feed));
+
+  ScopedZipWrap verified_zip;
+  ASSERT_TRUE(verified_zip.Open(file_path));
+  std::string content;
+  ASSERT_TRUE(verified_zip.ReadFile("empty.txt", &content));
+  EXPECT_EQ("", content);
+  ASSERT_TRUE(verified_zip.ReadFile("large.txt", &content));
+  EXPECT_TRUE(large_text == content);
+  ASSERT_TRUE(verified_zip.ReadFile("data.txt", &content));
+  EXPECT_EQ("asjkdjkasdjka lsdjas ljklasdjkl sjklddjsk", content);
+  ASSERT_TRUE(verified_zip.Close());
+}
+
 TEST_F(ReportUploadTest, FailureRecovery) {
   FilePath temp_store = temp_dir_.path().AppendASCII("FailureRecovery.temp");
   FilePath target_file = temp_dir_.path().AppendASCII("FailureRecovery.zip");
@@ -0,0 +1,160 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/allocation_site_stats.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "base/stringprintf.h"
+#include "syzygy/agent/asan/asan_logger.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+bool HasLargerOverhead(const AllocationSiteStats::SiteStats& site1,
+                       const AllocationSiteStats::SiteStats& site2) {
+  return site1.overhead_bytes() > site2.overhead_bytes();
+}
+
+}  // namespace
+
+AllocationSiteStats::AllocationSiteStats(size_t sampling_interval)
+    : sampling_interval_(sampling_interval), allocation_count_(0) {
+  DCHECK_LT(0U, sampling_interval);
+}
+
+bool AllocationSiteStats::ShouldSample() {
+  LONG count = ::InterlockedIncrement(&allocation_count_);
+  return static_cast<size_t>(count) % sampling_interval_ == 0;
+}
+
+void AllocationSiteStats::OnAlloc(StackId stack_id,
+                                  size_t user_size,
+                                  size_t block_size) {
+  DCHECK_LE(user_size, block_size);
+
+  base::AutoLock lock(lock_);
+  SiteStats& site = sites_[stack_id];
+  site.stack_id = stack_id;
+  ++site.live_blocks;
+  site.live_bytes += user_size;
+  site.redzone_bytes += block_size - user_size;
+}
+
+void AllocationSiteStats::OnQuarantine(StackId stack_id,
+                                       size_t user_size,
+                                       size_t block_size) {
+  DCHECK_LE(user_size, block_size);
+
+  base::AutoLock lock(lock_);
+  SiteStatsMap::iterator it = sites_.find(stack_id);
+  DCHECK(it != sites_.end());
+  SiteStats& site = it->second;
+  DCHECK_LT(0U, site.live_blocks);
+  --site.live_blocks;
+  site.live_bytes -= user_size;
+  site.redzone_bytes -= block_size - user_size;
+  ++site.quarantined_blocks;
+  site.quarantined_bytes += block_size;
+}
+
+void AllocationSiteStats::OnRelease(StackId stack_id,
+                                    size_t user_size,
+                                    size_t block_size,
+                                    bool quarantined) {
+  DCHECK_LE(user_size, block_size);
+
+  base::AutoLock lock(lock_);
+  SiteStatsMap::iterator it = sites_.find(stack_id);
+  DCHECK(it != sites_.end());
+  SiteStats& site = it->second;
+  if (quarantined) {
+    DCHECK_LT(0U, site.quarantined_blocks);
+    --site.quarantined_blocks;
+    site.quarantined_bytes -= block_size;
+  } else {
+    DCHECK_LT(0U, site.live_blocks);
+    --site.live_blocks;
+    site.live_bytes -= user_size;
+    site.redzone_bytes -= block_size - user_size;
+  }
+
+  // Forget about the sites that don't use any memory anymore, so that the
+  // short lived ones don't accumulate.
+  if (site.live_blocks == 0 && site.quarantined_blocks == 0)
+    sites_.erase(it);
+}
+
+void AllocationSiteStats::GetTopSites(size_t max_count,
+                                      SiteStatsVector* sites) const {
+  DCHECK(sites != NULL);
+
+  sites->clear();
+  {
+    base::AutoLock lock(lock_);
+    sites->reserve(sites_.size());
+    SiteStatsMap::const_iterator it = sites_.begin();
+    for (; it != sites_.end(); ++it)
+      sites->push_back(it->second);
+  }
+
+  size_t count = std::min(max_count, sites->size());
+  std::partial_sort(sites->begin(), sites->begin() + count, sites->end(),
+                    &HasLargerOverhead);
+  sites->resize(count);
+
+  for (size_t i = 0; i < count; ++i) {
+    SiteStats& site = (*sites)[i];
+    site.live_blocks *= sampling_interval_;
+    site.live_bytes *= sampling_interval_;
+    site.redzone_bytes *= sampling_interval_;
+    site.quarantined_blocks *= sampling_interval_;
+    site.quarantined_bytes *= sampling_interval_;
+  }
+}
+
+void AllocationSiteStats::LogTopSites(size_t max_count,
+                                      AsanLogger* logger) const {
+  DCHECK(logger != NULL);
+
+  SiteStatsVector sites;
+  GetTopSites(max_count, &sites);
+
+  std::string message(base::StringPrintf(
+      "PID=%d; Top %d allocation sites by overhead (1 in %d allocations "
+      "sampled):\n",
+      ::GetCurrentProcessId(),
+      sites.size(),
+      sampling_interval_));
+  for (size_t i = 0; i < sites.size(); ++i) {
+    const SiteStats& site = sites[i];
+    base::StringAppendF(
+        &message,
+        "    stack_id=0x%08X: %d live blocks of %d bytes with %d bytes of "
+        "redzones, %d quarantined blocks of %d bytes\n",
+        site.stack_id,
+        site.live_blocks,
+        site.live_bytes,
+        site.redzone_bytes,
+        site.quarantined_blocks,
+        site.quarantined_bytes);
+  }
+  logger->Write(message);
+}
+
+}  // namespace asan
+}  // namespace agent
@@ -0,0 +1,133 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a class which keeps sampled statistics about the memory used by
+// the ASan heap blocks, per allocation site.
+
+#ifndef SYZYGY_AGENT_ASAN_ALLOCATION_SITE_STATS_H_
+#define SYZYGY_AGENT_ASAN_ALLOCATION_SITE_STATS_H_
+
+#include <windows.h>  // NOLINT
+#include <vector>
+
+#include "base/hash_tables.h"
+#include "base/synchronization/lock.h"
+#include "syzygy/agent/asan/stack_capture.h"
+
+namespace agent {
+namespace asan {
+
+// Forward declaration.
+class AsanLogger;
+
+// A thread-safe accounting of the memory used by the heap blocks, keyed by
+// the ID of their allocation stack. Only one allocation out of every
+// sampling interval is accounted for, the reported values are scaled back up
+// accordingly.
+//
+// A sampled block goes through OnAlloc, then OnQuarantine when it's freed,
+// and OnRelease when it leaves the quarantine. A block which is released
+// while still allocated goes directly from OnAlloc to OnRelease.
+class AllocationSiteStats {
+ public:
+  // The type used to identify an allocation site.
+  typedef StackCapture::StackId StackId;
+
+  // The memory used by the blocks of an allocation site.
+  struct SiteStats {
+    SiteStats()
+        : stack_id(0),
+          live_blocks(0),
+          live_bytes(0),
+          redzone_bytes(0),
+          quarantined_blocks(0),
+          quarantined_bytes(0) {
+    }
+
+    // @returns the memory overhead of the site, in bytes.
+    size_t overhead_bytes() const { return redzone_bytes + quarantined_bytes; }
+
+    // The ID of the allocation stack of the site.
+    StackId stack_id;
+    // The number of allocated blocks, and their user size.
+    size_t live_blocks;
+    size_t live_bytes;
+    // The size of the redzones of the allocated blocks.
+    size_t redzone_bytes;
+    // The number of quarantined blocks, and their whole size.
+    size_t quarantined_blocks;
+    size_t quarantined_bytes;
+  };
+  typedef std::vector<SiteStats> SiteStatsVector;
+
+  // Initializes a new allocation site accounting.
+  // @param sampling_interval One allocation out of every @p sampling_interval
+  //     gets sampled. Must not be zero.
+  explicit AllocationSiteStats(size_t sampling_interval);
+
+  // @returns the sampling interval.
+  size_t sampling_interval() const { return sampling_interval_; }
+
+  // Decides whether the next allocation gets sampled. This is lock-free.
+  // @returns true if the allocation should be accounted for.
+  bool ShouldSample();
+
+  // @name Accounting of the sampled blocks.
+  // @param stack_id The ID of the allocation stack of the block.
+  // @param user_size The user size of the block.
+  // @param block_size The whole size of the block, redzones included.
+  // @{
+  void OnAlloc(StackId stack_id, size_t user_size, size_t block_size);
+  void OnQuarantine(StackId stack_id, size_t user_size, size_t block_size);
+  void OnRelease(StackId stack_id,
+                 size_t user_size,
+                 size_t block_size,
+                 bool quarantined);
+  // @}
+
+  // Gets the sites with the largest memory overhead, with their values
+  // scaled by the sampling interval.
+  // @param max_count The maximum number of sites to return.
+  // @param sites Receives the sites, by decreasing overhead.
+  void GetTopSites(size_t max_count, SiteStatsVector* sites) const;
+
+  // Logs the sites with the largest memory overhead.
+  // @param max_count The maximum number of sites to log.
+  // @param logger The logger to use.
+  void LogTopSites(size_t max_count, AsanLogger* logger) const;
+
+ protected:
+  typedef base::hash_map<StackId, SiteStats> SiteStatsMap;
+
+  // The sampling interval.
+  const size_t sampling_interval_;
+
+  // Counts the allocations, to decide which ones get sampled. This is only
+  // ever modified with interlocked operations.
+  volatile LONG allocation_count_;
+
+  // Protects the sites.
+  mutable base::Lock lock_;
+
+  // The accounting of the sampled blocks.
+  SiteStatsMap sites_;  // Under lock_.
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(AllocationSiteStats);
+};
+
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_ALLOCATION_SITE_STATS_H_
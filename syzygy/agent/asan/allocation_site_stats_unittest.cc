@@ -0,0 +1,103 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/allocation_site_stats.h"
+
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+class TestAllocationSiteStats : public AllocationSiteStats {
+ public:
+  explicit TestAllocationSiteStats(size_t sampling_interval)
+      : AllocationSiteStats(sampling_interval) {
+  }
+
+  using AllocationSiteStats::sites_;
+};
+
+}  // namespace
+
+TEST(AllocationSiteStatsTest, ShouldSample) {
+  TestAllocationSiteStats stats(4);
+  size_t sampled = 0;
+  for (size_t i = 0; i < 100; ++i) {
+    if (stats.ShouldSample())
+      ++sampled;
+  }
+  EXPECT_EQ(25U, sampled);
+}
+
+TEST(AllocationSiteStatsTest, BlockLifetime) {
+  TestAllocationSiteStats stats(1);
+  const AllocationSiteStats::StackId kStackId = 0x1234;
+
+  stats.OnAlloc(kStackId, 10, 48);
+  stats.OnAlloc(kStackId, 20, 56);
+  AllocationSiteStats::SiteStatsVector sites;
+  stats.GetTopSites(10, &sites);
+  ASSERT_EQ(1U, sites.size());
+  EXPECT_EQ(kStackId, sites[0].stack_id);
+  EXPECT_EQ(2U, sites[0].live_blocks);
+  EXPECT_EQ(30U, sites[0].live_bytes);
+  EXPECT_EQ(74U, sites[0].redzone_bytes);
+  EXPECT_EQ(0U, sites[0].quarantined_blocks);
+
+  // A quarantined block counts as overhead as a whole.
+  stats.OnQuarantine(kStackId, 10, 48);
+  stats.GetTopSites(10, &sites);
+  ASSERT_EQ(1U, sites.size());
+  EXPECT_EQ(1U, sites[0].live_blocks);
+  EXPECT_EQ(20U, sites[0].live_bytes);
+  EXPECT_EQ(36U, sites[0].redzone_bytes);
+  EXPECT_EQ(1U, sites[0].quarantined_blocks);
+  EXPECT_EQ(48U, sites[0].quarantined_bytes);
+  EXPECT_EQ(84U, sites[0].overhead_bytes());
+
+  // The site is forgotten once all of its blocks are released.
+  stats.OnRelease(kStackId, 10, 48, true);
+  stats.OnRelease(kStackId, 20, 56, false);
+  EXPECT_TRUE(stats.sites_.empty());
+}
+
+TEST(AllocationSiteStatsTest, GetTopSites) {
+  const size_t kSamplingInterval = 8;
+  TestAllocationSiteStats stats(kSamplingInterval);
+
+  // Site i has i blocks with 8 bytes of redzones each.
+  for (size_t i = 1; i <= 5; ++i) {
+    for (size_t j = 0; j < i; ++j)
+      stats.OnAlloc(i, 8, 16);
+  }
+
+  AllocationSiteStats::SiteStatsVector sites;
+  stats.GetTopSites(3, &sites);
+  ASSERT_EQ(3U, sites.size());
+  for (size_t i = 0; i < sites.size(); ++i) {
+    size_t expected_blocks = 5 - i;
+    EXPECT_EQ(5 - i, sites[i].stack_id);
+    EXPECT_EQ(expected_blocks * kSamplingInterval, sites[i].live_blocks);
+    EXPECT_EQ(expected_blocks * 8 * kSamplingInterval,
+              sites[i].redzone_bytes);
+  }
+
+  stats.GetTopSites(10, &sites);
+  EXPECT_EQ(5U, sites.size());
+}
+
+}  // namespace asan
+}  // namespace agent
@@ -21,6 +21,8 @@
       'target_name': 'syzyasan_rtl_lib',
       'type': 'static_library',
       'sources': [
+        'allocation_site_stats.cc',
+        'allocation_site_stats.h',
         'asan_heap.cc',
         'asan_heap.h',
         'asan_logger.cc',
@@ -107,6 +109,7 @@
       'target_name': 'syzyasan_rtl_unittests',
       'type': 'executable',
       'sources': [
+        'allocation_site_stats_unittest.cc',
         'asan_heap_unittest.cc',
         'asan_logger_unittest.cc',
         'asan_runtime_unittest.cc',
@@ -23,6 +23,7 @@
 #include "base/debug/alias.h"
 #include "base/debug/stack_trace.h"
 #include "base/strings/sys_string_conversions.h"
+#include "syzygy/agent/asan/allocation_site_stats.h"
 #include "syzygy/agent/asan/asan_runtime.h"
 #include "syzygy/agent/asan/asan_shadow.h"
 #include "syzygy/common/align.h"
@@ -74,15 +75,6 @@ double GetCpuCyclesPerUs() {
   }
 }
 
-// Verify that the memory range [mem, mem + len[ is accessible.
-bool MemoryRangeIsAccessible(uint8* mem, size_t len) {
-  for (size_t i = 0; i < len; ++i) {
-    if (!Shadow::IsAccessible(mem + i))
-      return false;
-  }
-  return true;
-}
-
 }  // namespace
 
 StackCaptureCache* HeapProxy::stack_cache_ = NULL;
@@ -90,6 +82,14 @@ double HeapProxy::cpu_cycles_per_us_ = 0.0;
 // The default quarantine size for a new Heap.
 size_t HeapProxy::default_quarantine_max_size_ = kDefaultQuarantineMaxSize;
 size_t HeapProxy::trailer_padding_size_ = kDefaultTrailerPaddingSize;
+size_t HeapProxy::alloc_stack_depth_ = StackCapture::kMaxNumFrames;
+size_t HeapProxy::free_stack_depth_ = StackCapture::kMaxNumFrames;
+bool HeapProxy::compact_free_stacks_ = false;
+AllocationSiteStats* HeapProxy::allocation_site_stats_ = NULL;
+size_t HeapProxy::adaptive_redzone_ratio_ = kDefaultAdaptiveRedzoneRatio;
+size_t HeapProxy::max_redzone_size_ = kDefaultMaxRedzoneSize;
+size_t HeapProxy::large_allocation_threshold_ =
+    kDefaultLargeAllocationThreshold;
 const char* HeapProxy::kHeapUseAfterFree = "heap-use-after-free";
 const char* HeapProxy::kHeapBufferUnderFlow = "heap-buffer-underflow";
 const char* HeapProxy::kHeapBufferOverFlow = "heap-buffer-overflow";
@@ -100,10 +100,11 @@ const char* HeapProxy::kHeapUnknownError = "heap-unknown-error";
 
 HeapProxy::HeapProxy()
     : heap_(NULL),
-      head_(NULL),
-      tail_(NULL),
       quarantine_size_(0),
       quarantine_max_size_(0) {
+  for (size_t i = 0; i < kBlockCacheSizeClasses; ++i)
+    ::InitializeSListHead(&block_cache_[i]);
+  InitializeListHead(&large_blocks_);
 }
 
 HeapProxy::~HeapProxy() {
@@ -117,6 +118,13 @@ void HeapProxy::Init(StackCaptureCache* cache) {
   DCHECK(cache != NULL);
   default_quarantine_max_size_ = kDefaultQuarantineMaxSize;
   trailer_padding_size_ = kDefaultTrailerPaddingSize;
+  alloc_stack_depth_ = StackCapture::kMaxNumFrames;
+  free_stack_depth_ = StackCapture::kMaxNumFrames;
+  compact_free_stacks_ = false;
+  large_allocation_threshold_ = kDefaultLargeAllocationThreshold;
+  allocation_site_stats_ = NULL;
+  adaptive_redzone_ratio_ = kDefaultAdaptiveRedzoneRatio;
+  max_redzone_size_ = kDefaultMaxRedzoneSize;
   stack_cache_ = cache;
 }
 
@@ -149,8 +157,27 @@ bool HeapProxy::Create(DWORD options,
 bool HeapProxy::Destroy() {
   DCHECK(heap_ != NULL);
 
-  // Flush the quarantine.
+  // Flush the quarantine, and the cache it drains into.
   SetQuarantineMaxSize(0);
+  FlushBlockCache();
+
+  // The large blocks that are still allocated aren't part of the underlying
+  // heap, so they must be released explicitly.
+  while (!IsListEmpty(&large_blocks_)) {
+    LargeBlockInfo* info = CONTAINING_RECORD(large_blocks_.Flink,
+                                             LargeBlockInfo,
+                                             list_entry);
+    BlockHeader* header = reinterpret_cast<BlockHeader*>(info + 1);
+    if (header->sampled && allocation_site_stats_ != NULL) {
+      allocation_site_stats_->OnRelease(
+          header->alloc_stack->stack_id(),
+          header->block_size,
+          GetBlockAllocSize(header),
+          false);
+    }
+    ReleaseASanBlock(header, BlockHeaderToBlockTrailer(header));
+    ReleaseLargeBlock(header);
+  }
 
   if (!::HeapDestroy(heap_))
     return false;
@@ -169,19 +196,147 @@ void* HeapProxy::Alloc(DWORD flags, size_t bytes) {
   if (alloc_size < bytes)
     return NULL;
 
-  uint8* block_mem = reinterpret_cast<uint8*>(
-      ::HeapAlloc(heap_, flags, alloc_size));
+  // Large allocations get pages of their own, which are zeroed. Otherwise,
+  // try to reuse a block evicted from the quarantine before going to the
+  // underlying heap, which is serialized.
+  bool large_block = large_allocation_threshold_ != 0 &&
+      alloc_size > large_allocation_threshold_;
+  uint8* block_mem = NULL;
+  if (large_block) {
+    block_mem = AllocLargeBlock(alloc_size);
+  } else {
+    block_mem = PopCachedBlock(alloc_size);
+    if (block_mem != NULL) {
+      if ((flags & HEAP_ZERO_MEMORY) != 0)
+        memset(block_mem, 0, alloc_size);
+    } else {
+      block_mem = reinterpret_cast<uint8*>(
+          ::HeapAlloc(heap_, flags, alloc_size));
+    }
+  }
+
+  // Capture the current stack. Stack walking is the most expensive part of
+  // an allocation, so this chases the frame pointers rather than calling
+  // ::CaptureStackBackTrace.
+  StackCapture stack(alloc_stack_depth_);
+  stack.InitFromFramePointers();
+
+  void* user_pointer = InitializeAsanBlock(block_mem,
+                                           bytes,
+                                           alloc_size,
+                                           kDefaultAllocGranularityLog,
+                                           stack);
+  if (user_pointer == NULL)
+    return NULL;
+
+  BlockHeader* header = UserPointerToBlockHeader(user_pointer);
+  if (large_block)
+    header->large_block = 1;
+  header->adaptive_padding_log = GetAdaptivePaddingLog(bytes);
+  DCHECK_EQ(alloc_size, GetBlockAllocSize(header));
+
+  // Account for a sample of the allocations in the per-site statistics.
+  if (allocation_site_stats_ != NULL &&
+      allocation_site_stats_->ShouldSample()) {
+    header->sampled = 1;
+    allocation_site_stats_->OnAlloc(header->alloc_stack->stack_id(),
+                                    bytes,
+                                    alloc_size);
+  }
+
+  return user_pointer;
+}
+
+uint8* HeapProxy::AllocLargeBlock(size_t alloc_size) {
+  size_t pages_size = common::AlignUp(sizeof(LargeBlockInfo) + alloc_size,
+                                      kLargeBlockPageSize);
+  size_t region_size = pages_size + 2 * kLargeBlockPageSize;
+  if (region_size < alloc_size)
+    return NULL;
+
+  // The guard pages are only reserved, so that touching them faults.
+  uint8* region = reinterpret_cast<uint8*>(
+      ::VirtualAlloc(NULL, region_size, MEM_RESERVE, PAGE_NOACCESS));
+  if (region == NULL)
+    return NULL;
+  uint8* pages = region + kLargeBlockPageSize;
+  if (::VirtualAlloc(pages, pages_size, MEM_COMMIT, PAGE_READWRITE) == NULL) {
+    ::VirtualFree(region, 0, MEM_RELEASE);
+    return NULL;
+  }
+
+  uint8* asan_pointer = pages + pages_size - alloc_size;
+  LargeBlockInfo* info = reinterpret_cast<LargeBlockInfo*>(asan_pointer) - 1;
+  info->region_size = region_size;
+  DCHECK_EQ(region, LargeBlockInfoToRegion(info));
 
-  // Capture the current stack. InitFromStack is inlined to preserve the
-  // greatest number of stack frames.
-  StackCapture stack;
-  stack.InitFromStack();
+  // The shadow memory of the block itself is poisoned by InitializeAsanBlock.
+  // The rest of the region is made of whole pages, save for the padding.
+  Shadow::Poison(region, asan_pointer - region, Shadow::kHeapLeftRedzone);
+  Shadow::Poison(pages + pages_size,
+                 kLargeBlockPageSize,
+                 Shadow::kHeapRightRedzone);
 
-  return InitializeAsanBlock(block_mem,
-                             bytes,
-                             alloc_size,
-                             kDefaultAllocGranularityLog,
-                             stack);
+  base::AutoLock lock(large_blocks_lock_);
+  InsertTailList(&large_blocks_, &info->list_entry);
+  return asan_pointer;
+}
+
+void HeapProxy::ReleaseLargeBlock(BlockHeader* header) {
+  DCHECK(header != NULL);
+  DCHECK(header->large_block);
+
+  LargeBlockInfo* info = BlockHeaderToLargeBlockInfo(header);
+  {
+    base::AutoLock lock(large_blocks_lock_);
+    RemoveEntryList(&info->list_entry);
+  }
+
+  // The shadow memory of the whole pages of the region is simply
+  // decommitted, rather than unpoisoned byte by byte.
+  uint8* region = LargeBlockInfoToRegion(info);
+  Shadow::UnpoisonAndDecommit(region, info->region_size);
+  ::VirtualFree(region, 0, MEM_RELEASE);
+}
+
+HeapProxy::BlockHeader* HeapProxy::FindLargeBlock(const void* addr) {
+  base::AutoLock lock(large_blocks_lock_);
+  LIST_ENTRY* entry = large_blocks_.Flink;
+  for (; entry != &large_blocks_; entry = entry->Flink) {
+    LargeBlockInfo* info = CONTAINING_RECORD(entry,
+                                             LargeBlockInfo,
+                                             list_entry);
+    const uint8* region = LargeBlockInfoToRegion(info);
+    if (addr < region || addr >= region + info->region_size)
+      continue;
+
+    // The block may be being initialized or released.
+    BlockHeader* header = reinterpret_cast<BlockHeader*>(info + 1);
+    if (header->magic_number != kBlockHeaderSignature ||
+        header->state == FREED) {
+      return NULL;
+    }
+    return header;
+  }
+
+  return NULL;
+}
+
+HeapProxy::LargeBlockInfo* HeapProxy::BlockHeaderToLargeBlockInfo(
+    const BlockHeader* header) {
+  DCHECK(header != NULL);
+  return reinterpret_cast<LargeBlockInfo*>(
+      const_cast<BlockHeader*>(header)) - 1;
+}
+
+uint8* HeapProxy::LargeBlockInfoToRegion(const LargeBlockInfo* info) {
+  DCHECK(info != NULL);
+
+  // The information is always in the first page following the leading guard
+  // page.
+  return reinterpret_cast<uint8*>(
+      common::AlignDown(reinterpret_cast<size_t>(info), kLargeBlockPageSize) -
+          kLargeBlockPageSize);
 }
 
 void* HeapProxy::InitializeAsanBlock(uint8* asan_pointer,
@@ -233,6 +388,9 @@ void* HeapProxy::InitializeAsanBlock(uint8* asan_pointer,
 
   // Initialize the block fields.
   block_header->magic_number = kBlockHeaderSignature;
+  block_header->large_block = 0;
+  block_header->sampled = 0;
+  block_header->adaptive_padding_log = 0;
   block_header->block_size = user_size;
   block_header->state = ALLOCATED;
   block_header->alloc_stack = stack_cache_->SaveStackTrace(stack);
@@ -245,7 +403,7 @@ void* HeapProxy::InitializeAsanBlock(uint8* asan_pointer,
   block_trailer->next_free_block = NULL;
 
   uint8* block_alloc = BlockHeaderToUserPointer(block_header);
-  DCHECK(MemoryRangeIsAccessible(block_alloc, user_size));
+  DCHECK(Shadow::IsRangeAccessible(block_alloc, user_size));
 
   // Poison the block trailer.
   Shadow::Poison(block_alloc + user_size,
@@ -258,7 +416,14 @@ void* HeapProxy::InitializeAsanBlock(uint8* asan_pointer,
 void* HeapProxy::ReAlloc(DWORD flags, void* mem, size_t bytes) {
   DCHECK(heap_ != NULL);
 
-  // Always fail in-place reallocation requests.
+  // Resizing the block where it is avoids both the copy and the trip of the
+  // old block through the quarantine.
+  if (mem != NULL) {
+    BlockHeader* header = UserPointerToBlockHeader(mem);
+    if (header != NULL && ResizeBlockInPlace(header, bytes, flags))
+      return mem;
+  }
+
   if ((flags & HEAP_REALLOC_IN_PLACE_ONLY) != 0)
     return NULL;
 
@@ -276,6 +441,72 @@ void* HeapProxy::ReAlloc(DWORD flags, void* mem, size_t bytes) {
   return new_mem;
 }
 
+bool HeapProxy::ResizeBlockInPlace(BlockHeader* block_header,
+                                   size_t bytes,
+                                   DWORD flags) {
+  DCHECK(block_header != NULL);
+
+  if (block_header->state != ALLOCATED)
+    return false;
+
+  size_t alloc_size = GetBlockAllocSize(block_header);
+  if (bytes >= alloc_size)
+    return false;
+
+  // The footprint of a block is derived from its header, so whatever the
+  // new size leaves of it must be an adaptive padding the header can hold.
+  size_t min_alloc_size = ComputeAllocSize(bytes,
+                                           1 << block_header->alignment_log,
+                                           0);
+  if (min_alloc_size > alloc_size)
+    return false;
+  size_t padding_size = alloc_size - min_alloc_size;
+  size_t padding_log = 0;
+  if (padding_size != 0) {
+    padding_log = Shadow::kShadowGranularityLog;
+    while ((static_cast<size_t>(1) << padding_log) < padding_size)
+      ++padding_log;
+    if ((static_cast<size_t>(1) << padding_log) != padding_size)
+      return false;
+  }
+
+  uint8* user_pointer = BlockHeaderToUserPointer(block_header);
+  uint8* block_end = BlockHeaderToAsanPointer(block_header) + alloc_size;
+  size_t old_bytes = block_header->block_size;
+
+  if (block_header->sampled && allocation_site_stats_ != NULL) {
+    allocation_site_stats_->OnRelease(block_header->alloc_stack->stack_id(),
+                                      old_bytes,
+                                      alloc_size,
+                                      false);
+  }
+
+  // The trailer follows the end of the user data.
+  BlockTrailer trailer = *BlockHeaderToBlockTrailer(block_header);
+  block_header->block_size = bytes;
+  block_header->adaptive_padding_log = padding_log;
+  DCHECK_EQ(alloc_size, GetBlockAllocSize(block_header));
+  *BlockHeaderToBlockTrailer(block_header) = trailer;
+
+  if (bytes > old_bytes && (flags & HEAP_ZERO_MEMORY) != 0)
+    memset(user_pointer + old_bytes, 0, bytes - old_bytes);
+
+  // Red-zone everything past the new end of the user data, so that accesses
+  // to the trimmed bytes are still caught.
+  Shadow::Unpoison(user_pointer, bytes);
+  Shadow::Poison(user_pointer + bytes,
+                 block_end - (user_pointer + bytes),
+                 Shadow::kHeapRightRedzone);
+
+  if (block_header->sampled && allocation_site_stats_ != NULL) {
+    allocation_site_stats_->OnAlloc(block_header->alloc_stack->stack_id(),
+                                    bytes,
+                                    alloc_size);
+  }
+
+  return true;
+}
+
 bool HeapProxy::Free(DWORD flags, void* mem) {
   DCHECK(heap_ != NULL);
   BlockHeader* block = UserPointerToBlockHeader(mem);
@@ -287,14 +518,21 @@ bool HeapProxy::Free(DWORD flags, void* mem) {
   DCHECK(BlockHeaderToUserPointer(block) == mem);
 
   // Capture the current stack.
-  StackCapture stack;
-  stack.InitFromStack();
+  StackCapture stack(free_stack_depth_);
+  stack.InitFromFramePointers();
 
   // Mark the block as quarantined.
   if (!MarkBlockAsQuarantined(block, stack))
     return false;
 
-  QuarantineBlock(block);
+  if (block->sampled && allocation_site_stats_ != NULL) {
+    allocation_site_stats_->OnQuarantine(
+        block->alloc_stack->stack_id(),
+        block->block_size,
+        GetBlockAllocSize(block));
+  }
+
+  QuarantineBlock(block, stack);
 
   return true;
 }
@@ -311,7 +549,14 @@ bool HeapProxy::MarkBlockAsQuarantined(BlockHeader* block_header,
   }
 
   BlockTrailer* trailer = BlockHeaderToBlockTrailer(block_header);
-  trailer->free_stack = stack_cache_->SaveStackTrace(stack);
+  if (compact_free_stacks_) {
+    // Most quarantined blocks are never reported, so don't go through the
+    // stack cache for them. QuarantineBlock keeps the full stack of the
+    // most recent ones.
+    trailer->free_stack_id = stack.stack_id() | kCompactFreeStackTag;
+  } else {
+    trailer->free_stack = stack_cache_->SaveStackTrace(stack);
+  }
   trailer->free_timestamp = trace::common::GetTsc();
   trailer->free_tid = ::GetCurrentThreadId();
 
@@ -345,11 +590,16 @@ size_t HeapProxy::Size(DWORD flags, const void* mem) {
 
 bool HeapProxy::Validate(DWORD flags, const void* mem) {
   DCHECK(heap_ != NULL);
-  return ::HeapValidate(heap_, flags, UserPointerToBlockHeader(mem)) == TRUE;
+  BlockHeader* header = UserPointerToBlockHeader(mem);
+  // The large blocks aren't part of the underlying heap.
+  if (header != NULL && header->large_block)
+    return true;
+  return ::HeapValidate(heap_, flags, header) == TRUE;
 }
 
 size_t HeapProxy::Compact(DWORD flags) {
   DCHECK(heap_ != NULL);
+  FlushBlockCache();
   return ::HeapCompact(heap_, flags);
 }
 
@@ -388,51 +638,156 @@ bool HeapProxy::QueryInformation(HEAP_INFORMATION_CLASS info_class,
 }
 
 void HeapProxy::SetQuarantineMaxSize(size_t quarantine_max_size) {
-  {
-    base::AutoLock lock(lock_);
-    quarantine_max_size_ = quarantine_max_size;
-  }
+  quarantine_max_size_ = quarantine_max_size;
 
-  TrimQuarantine();
+  TrimQuarantine(quarantine_max_size);
 }
 
-void HeapProxy::TrimQuarantine() {
-  while (true) {
-    BlockHeader* free_block = NULL;
-    BlockTrailer* trailer = NULL;
-    size_t alloc_size = 0;
+size_t HeapProxy::GetQuarantineShardIndex() {
+  // Thread ids are multiples of 4, so drop the bits that never vary.
+  return (::GetCurrentThreadId() >> 2) % kQuarantineShardCount;
+}
 
-    // This code runs under a critical lock. Try to keep as much work out of
-    // this scope as possible!
-    {
-      base::AutoLock lock(lock_);
-      if (quarantine_size_ <= quarantine_max_size_)
+void HeapProxy::TrimQuarantine(size_t target_size) {
+  if (static_cast<size_t>(quarantine_size_) <= target_size)
+    return;
+
+  size_t shard_budget = quarantine_max_size_ / kQuarantineShardCount;
+  size_t first_shard = GetQuarantineShardIndex();
+
+  // The first pass takes back the overage of the shards holding more than
+  // their share of the budget. If this isn't enough the second pass evicts
+  // blocks from any shard. The current thread's shard, which holds the most
+  // recently freed block, is visited last in both passes.
+  for (size_t pass = 0; pass < 2; ++pass) {
+    size_t shard_floor = pass == 0 ? shard_budget : 0;
+    for (size_t i = 1; i <= kQuarantineShardCount; ++i) {
+      if (static_cast<size_t>(quarantine_size_) <= target_size)
         return;
 
-      DCHECK(head_ != NULL);
-      DCHECK(tail_ != NULL);
+      QuarantineShard* shard =
+          &quarantine_shards_[(first_shard + i) % kQuarantineShardCount];
+      ReleaseEvictedBlocks(
+          TrimQuarantineShard(shard, target_size, shard_floor));
+    }
+  }
+}
 
-      free_block = head_;
-      trailer = BlockHeaderToBlockTrailer(free_block);
-      DCHECK(trailer != NULL);
+HeapProxy::BlockHeader* HeapProxy::TrimQuarantineShard(
+    QuarantineShard* shard, size_t target_size, size_t shard_floor) {
+  DCHECK(shard != NULL);
+
+  // This code runs under a critical lock. Try to keep as much work out of
+  // this scope as possible! All of the blocks that need to be evicted are
+  // detached in one go, and released outside of the lock.
+  base::AutoLock lock(shard->lock);
+  BlockHeader* evicted_blocks = shard->head;
+  BlockHeader* last_evicted_block = NULL;
+  while (shard->head != NULL && shard->size > shard_floor &&
+         static_cast<size_t>(quarantine_size_) > target_size) {
+    DCHECK(shard->tail != NULL);
+
+    last_evicted_block = shard->head;
+    BlockTrailer* trailer = BlockHeaderToBlockTrailer(shard->head);
+    DCHECK(trailer != NULL);
+
+    size_t alloc_size = GetBlockAllocSize(shard->head);
+    DCHECK_GE(shard->size, alloc_size);
+    shard->size -= alloc_size;
+    ::InterlockedExchangeAdd(&quarantine_size_,
+                             -static_cast<LONG>(alloc_size));
+
+    shard->head = trailer->next_free_block;
+    if (shard->head == NULL)
+      shard->tail = NULL;
+  }
 
-      head_ = trailer->next_free_block;
-      if (head_ == NULL)
-        tail_ = NULL;
+  if (last_evicted_block == NULL)
+    return NULL;
 
-      alloc_size = GetAllocSize(free_block->block_size,
-                                kDefaultAllocGranularity);
+  // Terminate the list of evicted blocks.
+  BlockHeaderToBlockTrailer(last_evicted_block)->next_free_block = NULL;
+  return evicted_blocks;
+}
 
-      DCHECK_GE(quarantine_size_, alloc_size);
-      quarantine_size_ -= alloc_size;
+void HeapProxy::ReleaseEvictedBlocks(BlockHeader* evicted_blocks) {
+  while (evicted_blocks != NULL) {
+    BlockHeader* free_block = evicted_blocks;
+    BlockTrailer* trailer = BlockHeaderToBlockTrailer(free_block);
+    DCHECK(trailer != NULL);
+    evicted_blocks = trailer->next_free_block;
+    trailer->next_free_block = NULL;
+
+    size_t alloc_size = GetBlockAllocSize(free_block);
+
+    if (free_block->sampled && allocation_site_stats_ != NULL) {
+      allocation_site_stats_->OnRelease(free_block->alloc_stack->stack_id(),
+                                        free_block->block_size,
+                                        alloc_size,
+                                        true);
     }
 
     // Clean up the block's metadata. We do this outside of the heap lock to
     // reduce contention.
     ReleaseASanBlock(free_block, trailer);
 
+    if (free_block->large_block) {
+      ReleaseLargeBlock(free_block);
+      continue;
+    }
+
     Shadow::Unpoison(free_block, alloc_size);
-    ::HeapFree(heap_, 0, free_block);
+    ReleaseEvictedBlock(reinterpret_cast<uint8*>(free_block), alloc_size);
+  }
+}
+
+uint8* HeapProxy::PopCachedBlock(size_t alloc_size) {
+  DCHECK_EQ(0u, alloc_size % kBlockCacheGranularity);
+  if (alloc_size == 0 || alloc_size > kBlockCacheMaxBlockSize)
+    return NULL;
+
+  SLIST_HEADER* cache = &block_cache_[alloc_size / kBlockCacheGranularity - 1];
+  SLIST_ENTRY* entry = ::InterlockedPopEntrySList(cache);
+  if (entry == NULL)
+    return NULL;
+
+  return reinterpret_cast<uint8*>(
+      CONTAINING_RECORD(entry, CachedBlock, list_entry));
+}
+
+void HeapProxy::ReleaseEvictedBlock(uint8* block, size_t alloc_size) {
+  DCHECK(block != NULL);
+  DCHECK_EQ(0u, alloc_size % kBlockCacheGranularity);
+  COMPILE_ASSERT(sizeof(CachedBlock) <= sizeof(BlockHeader),
+                 asan_cached_block_too_big);
+
+  if (alloc_size <= kBlockCacheMaxBlockSize) {
+    SLIST_HEADER* cache =
+        &block_cache_[alloc_size / kBlockCacheGranularity - 1];
+
+    // The depth is only approximate in the face of concurrent releases, but
+    // that's good enough to keep the cache bounded.
+    if (::QueryDepthSList(cache) < kBlockCacheMaxDepth) {
+      CachedBlock* cached_block = reinterpret_cast<CachedBlock*>(block);
+      cached_block->magic_number = 0;
+      ::InterlockedPushEntrySList(cache, &cached_block->list_entry);
+      return;
+    }
+  }
+
+  ::HeapFree(heap_, 0, block);
+}
+
+void HeapProxy::FlushBlockCache() {
+  DCHECK(heap_ != NULL);
+
+  for (size_t i = 0; i < kBlockCacheSizeClasses; ++i) {
+    SLIST_ENTRY* entry = ::InterlockedFlushSList(&block_cache_[i]);
+    while (entry != NULL) {
+      SLIST_ENTRY* next = entry->Next;
+      ::HeapFree(heap_, 0, CONTAINING_RECORD(entry, CachedBlock, list_entry));
+      entry = next;
+    }
   }
 }
 
@@ -443,7 +798,9 @@ void HeapProxy::ReleaseASanBlock(BlockHeader* block_header,
     stack_cache_->ReleaseStackTrace(block_header->alloc_stack);
     block_header->alloc_stack = NULL;
   }
-  if (block_trailer->free_stack != NULL) {
+  if (HasCompactFreeStack(block_trailer)) {
+    block_trailer->free_stack = NULL;
+  } else if (block_trailer->free_stack != NULL) {
     stack_cache_->ReleaseStackTrace(block_trailer->free_stack);
     block_trailer->free_stack = NULL;
   }
@@ -451,36 +808,119 @@ void HeapProxy::ReleaseASanBlock(BlockHeader* block_header,
   block_header->state = FREED;
 }
 
-void HeapProxy::QuarantineBlock(BlockHeader* block) {
+void HeapProxy::QuarantineBlock(BlockHeader* block,
+                                const StackCapture& free_stack) {
   DCHECK(block != NULL);
 
   DCHECK(BlockHeaderToBlockTrailer(block)->next_free_block == NULL);
-  size_t alloc_size = GetAllocSize(block->block_size,
-                                   kDefaultAllocGranularity);
+  size_t alloc_size = GetBlockAllocSize(block);
 
-  {
-    base::AutoLock lock(lock_);
+  // A block larger than the whole quarantine is released right away.
+  size_t max_size = quarantine_max_size_;
+  if (alloc_size > max_size) {
+    ReleaseEvictedBlocks(block);
+    return;
+  }
 
-    quarantine_size_ += alloc_size;
-    if (tail_ != NULL) {
-      BlockHeaderToBlockTrailer(tail_)->next_free_block = block;
-    } else {
-      DCHECK(head_ == NULL);
-      head_ = block;
+  // Most frees leave the quarantine under its maximum size. Otherwise, it's
+  // trimmed to make room for the block, with some slack so that the cost of
+  // trimming is amortized over several frees.
+  size_t slack = max_size / kQuarantineTrimSlackDivisor;
+  size_t trim_size = max_size - alloc_size;
+  trim_size = trim_size > slack ? trim_size - slack : 0;
+
+  QuarantineShard* shard = &quarantine_shards_[GetQuarantineShardIndex()];
+  while (true) {
+    {
+      base::AutoLock lock(shard->lock);
+
+      // The room for the block is reserved and the block is inserted under
+      // the shard lock. This way the total size only accounts for the blocks
+      // that are in a shard, or that are being inserted under a lock that
+      // trimming waits for. Concurrent frees can't push it over the limit
+      // between its check and its update.
+      if (ReserveQuarantineSize(alloc_size, max_size)) {
+        shard->size += alloc_size;
+        if (shard->tail != NULL) {
+          BlockHeaderToBlockTrailer(shard->tail)->next_free_block = block;
+        } else {
+          DCHECK(shard->head == NULL);
+          shard->head = block;
+        }
+        shard->tail = block;
+
+        if (HasCompactFreeStack(BlockHeaderToBlockTrailer(block))) {
+          RecentFreeStack* recent =
+              &shard->recent_free_stacks[shard->next_recent_free_stack];
+          shard->next_recent_free_stack =
+              (shard->next_recent_free_stack + 1) % kRecentFreeStacksPerShard;
+          recent->block = block;
+          recent->stack.InitFromBuffer(free_stack.stack_id(),
+                                       free_stack.frames(),
+                                       free_stack.num_frames());
+        }
+        return;
+      }
     }
-    tail_ = block;
+
+    TrimQuarantine(trim_size);
   }
+}
 
-  TrimQuarantine();
+bool HeapProxy::ReserveQuarantineSize(size_t size, size_t max_size) {
+  LONG old_size = quarantine_size_;
+  while (static_cast<size_t>(old_size) + size <= max_size) {
+    LONG previous_size = ::InterlockedCompareExchange(
+        &quarantine_size_, old_size + static_cast<LONG>(size), old_size);
+    if (previous_size == old_size)
+      return true;
+    old_size = previous_size;
+  }
+  return false;
 }
 
 size_t HeapProxy::GetAllocSize(size_t bytes, size_t alignment) {
+  return ComputeAllocSize(bytes, alignment, GetAdaptivePaddingLog(bytes));
+}
+
+size_t HeapProxy::GetBlockAllocSize(const BlockHeader* header) {
+  DCHECK(header != NULL);
+  return ComputeAllocSize(header->block_size,
+                          1 << header->alignment_log,
+                          header->adaptive_padding_log);
+}
+
+size_t HeapProxy::ComputeAllocSize(size_t bytes,
+                                   size_t alignment,
+                                   size_t adaptive_padding_log) {
   bytes += std::max(sizeof(BlockHeader), alignment);
   bytes += sizeof(BlockTrailer);
   bytes += trailer_padding_size_;
+  if (adaptive_padding_log != 0)
+    bytes += static_cast<size_t>(1) << adaptive_padding_log;
   return common::AlignUp(bytes, Shadow::kShadowGranularity);
 }
 
+size_t HeapProxy::GetAdaptivePaddingLog(size_t bytes) {
+  if (adaptive_redzone_ratio_ == 0)
+    return 0;
+
+  // The header and the trailer are the smallest redzones a block can have,
+  // so the tiny blocks get no padding at all.
+  size_t target_size = std::min(bytes / adaptive_redzone_ratio_,
+                                max_redzone_size_);
+  size_t fixed_size = sizeof(BlockHeader) + sizeof(BlockTrailer) +
+      trailer_padding_size_;
+  if (target_size <= fixed_size)
+    return 0;
+
+  // Round the padding up to a power of two, so that it fits in the header.
+  size_t padding_log = Shadow::kShadowGranularityLog;
+  while ((static_cast<size_t>(1) << padding_log) < target_size - fixed_size)
+    ++padding_log;
+  return padding_log;
+}
+
 HeapProxy::BlockHeader* HeapProxy::UserPointerToBlockHeader(
     const void* user_pointer) {
   if (user_pointer == NULL)
@@ -604,12 +1044,51 @@ HeapProxy::BlockHeader* HeapProxy::FindAddressBlock(const void* addr) {
     }
   }
 
+  if (header == NULL)
+    header = FindLargeBlock(addr);
+
   return header;
 }
 
 bool HeapProxy::GetBadAccessInformation(AsanErrorInfo* bad_access_info) {
   DCHECK(bad_access_info != NULL);
-  base::AutoLock lock(lock_);
+
+  // Hold all of the quarantine shards so that the block can't be evicted
+  // while we're examining it.
+  for (size_t i = 0; i < kQuarantineShardCount; ++i)
+    quarantine_shards_[i].lock.Acquire();
+  bool result = GetBadAccessInformationUnlocked(bad_access_info);
+  for (size_t i = kQuarantineShardCount; i > 0; --i)
+    quarantine_shards_[i - 1].lock.Release();
+
+  return result;
+}
+
+const StackCapture* HeapProxy::FindRecentFreeStackUnlocked(
+    const BlockHeader* header) {
+  DCHECK(header != NULL);
+
+  // The block may have been evicted and reused since an entry was recorded
+  // for it, so the entry must also match its free stack ID.
+  const BlockTrailer* trailer = BlockHeaderToBlockTrailer(header);
+  for (size_t i = 0; i < kQuarantineShardCount; ++i) {
+    const QuarantineShard& shard = quarantine_shards_[i];
+    for (size_t j = 0; j < kRecentFreeStacksPerShard; ++j) {
+      const RecentFreeStack& recent = shard.recent_free_stacks[j];
+      if (recent.block == header &&
+          (recent.stack.stack_id() | kCompactFreeStackTag) ==
+              trailer->free_stack_id) {
+        return &recent.stack;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+bool HeapProxy::GetBadAccessInformationUnlocked(
+    AsanErrorInfo* bad_access_info) {
+  DCHECK(bad_access_info != NULL);
   BlockHeader* header = FindAddressBlock(bad_access_info->location);
 
   if (header == NULL)
@@ -634,11 +1113,17 @@ bool HeapProxy::GetBadAccessInformation(AsanErrorInfo* bad_access_info) {
       bad_access_info->alloc_stack_size = header->alloc_stack->num_frames();
       bad_access_info->alloc_tid = header->alloc_tid;
     }
-    if (trailer->free_stack != NULL) {
+    const StackCapture* free_stack = trailer->free_stack;
+    if (HasCompactFreeStack(trailer)) {
+      bad_access_info->free_stack_id = trailer->free_stack_id;
+      bad_access_info->free_tid = trailer->free_tid;
+      free_stack = FindRecentFreeStackUnlocked(header);
+    }
+    if (free_stack != NULL) {
       memcpy(bad_access_info->free_stack,
-             trailer->free_stack->frames(),
-             trailer->free_stack->num_frames() * sizeof(void*));
-      bad_access_info->free_stack_size = trailer->free_stack->num_frames();
+             free_stack->frames(),
+             free_stack->num_frames() * sizeof(void*));
+      bad_access_info->free_stack_size = free_stack->num_frames();
       bad_access_info->free_tid = trailer->free_tid;
     }
     GetAddressInformation(header, bad_access_info);
@@ -31,6 +31,7 @@ namespace agent {
 namespace asan {
 
 // Forward declaration.
+class AllocationSiteStats;
 class StackCapture;
 class StackCaptureCache;
 struct AsanErrorInfo;
@@ -158,6 +159,105 @@ class HeapProxy {
     return trailer_padding_size_;
   }
 
+  // Set the maximum depth of the stack traces captured on allocation.
+  // @param alloc_stack_depth The depth, between 1 and
+  //     StackCapture::kMaxNumFrames.
+  static void set_alloc_stack_depth(size_t alloc_stack_depth) {
+    DCHECK_LT(0U, alloc_stack_depth);
+    DCHECK_GE(StackCapture::kMaxNumFrames, alloc_stack_depth);
+    alloc_stack_depth_ = alloc_stack_depth;
+  }
+
+  // Get the maximum depth of the stack traces captured on allocation.
+  static size_t alloc_stack_depth() {
+    return alloc_stack_depth_;
+  }
+
+  // Set the maximum depth of the stack traces captured on free.
+  // @param free_stack_depth The depth, between 1 and
+  //     StackCapture::kMaxNumFrames.
+  static void set_free_stack_depth(size_t free_stack_depth) {
+    DCHECK_LT(0U, free_stack_depth);
+    DCHECK_GE(StackCapture::kMaxNumFrames, free_stack_depth);
+    free_stack_depth_ = free_stack_depth;
+  }
+
+  // Get the maximum depth of the stack traces captured on free.
+  static size_t free_stack_depth() {
+    return free_stack_depth_;
+  }
+
+  // Enable or disable compact free stacks. When enabled, a quarantined block
+  // only keeps the ID of its free stack, rather than a reference to a stack
+  // capture in the stack cache. The full free stacks are kept for the blocks
+  // most recently quarantined only.
+  // @param compact_free_stacks True to enable compact free stacks.
+  static void set_compact_free_stacks(bool compact_free_stacks) {
+    compact_free_stacks_ = compact_free_stacks;
+  }
+
+  // Get whether compact free stacks are enabled.
+  static bool compact_free_stacks() {
+    return compact_free_stacks_;
+  }
+
+  // Set the size above which allocations bypass the underlying heap. These
+  // get pages of their own, surrounded by guard pages.
+  // @param large_allocation_threshold The threshold, in bytes. Zero disables
+  //     this.
+  static void set_large_allocation_threshold(
+      size_t large_allocation_threshold) {
+    large_allocation_threshold_ = large_allocation_threshold;
+  }
+
+  // Get the size above which allocations bypass the underlying heap.
+  static size_t large_allocation_threshold() {
+    return large_allocation_threshold_;
+  }
+
+  // Set the ratio of the allocation size the redzones of a block aim for.
+  // The trailer of the blocks whose header and trailer are smaller than this
+  // gets padded with a power of two number of bytes, up to the maximum
+  // redzone size.
+  // @param adaptive_redzone_ratio The ratio, zero disables this.
+  static void set_adaptive_redzone_ratio(size_t adaptive_redzone_ratio) {
+    adaptive_redzone_ratio_ = adaptive_redzone_ratio;
+  }
+
+  // Get the ratio of the allocation size the redzones of a block aim for.
+  static size_t adaptive_redzone_ratio() {
+    return adaptive_redzone_ratio_;
+  }
+
+  // Set the size above which the adaptive redzones don't grow.
+  // @param max_redzone_size The size, in bytes.
+  static void set_max_redzone_size(size_t max_redzone_size) {
+    DCHECK_GE(kMaxRedzoneSizeLimit, max_redzone_size);
+    max_redzone_size_ = max_redzone_size;
+  }
+
+  // Get the size above which the adaptive redzones don't grow.
+  static size_t max_redzone_size() {
+    return max_redzone_size_;
+  }
+
+  // The largest supported maximum redzone size.
+  static const size_t kMaxRedzoneSizeLimit = 1024 * 1024;
+
+  // Set the per-allocation-site statistics the sampled allocations are
+  // accounted in.
+  // @param allocation_site_stats The statistics, or NULL to disable the
+  //     sampling. This must outlive the blocks sampled into it.
+  static void set_allocation_site_stats(
+      AllocationSiteStats* allocation_site_stats) {
+    allocation_site_stats_ = allocation_site_stats;
+  }
+
+  // Get the per-allocation-site statistics, or NULL if there are none.
+  static AllocationSiteStats* allocation_site_stats() {
+    return allocation_site_stats_;
+  }
+
   // Static initialization of HeapProxy context.
   // @param cache The stack capture cache shared by the HeapProxy.
   static void Init(StackCaptureCache* cache);
@@ -174,7 +274,14 @@ class HeapProxy {
 
   // Every allocated block starts with a BlockHeader...
   struct BlockHeader {
-    size_t magic_number : 24;
+    size_t magic_number : 17;
+    // Set for the blocks that have pages of their own.
+    size_t large_block : 1;
+    // Set for the blocks accounted in allocation_site_stats_.
+    size_t sampled : 1;
+    // The log of the adaptive padding of the trailer, or zero if there's
+    // none. See GetAdaptivePaddingLog.
+    size_t adaptive_padding_log : 5;
     BlockState state : 4;
     size_t alignment_log : 4;
     size_t block_size;
@@ -189,7 +296,13 @@ class HeapProxy {
   #pragma pack(push, 4)
   struct BlockTrailer {
     uint64 free_timestamp;
-    const StackCapture* free_stack;
+    // A block quarantined with compact free stacks only keeps the ID of its
+    // free stack, tagged with kCompactFreeStackTag. Stack captures are
+    // aligned, so a pointer to one never has this bit set.
+    union {
+      const StackCapture* free_stack;
+      StackCapture::StackId free_stack_id;
+    };
     DWORD free_tid;
     // Free blocks are linked together.
     BlockHeader* next_free_block;
@@ -197,9 +310,89 @@ class HeapProxy {
   #pragma pack(pop)
   COMPILE_ASSERT(sizeof(BlockTrailer) == 20, asan_block_trailer_too_big);
 
+  // Tags the free stack IDs of the blocks with compact free stacks.
+  static const StackCapture::StackId kCompactFreeStackTag = 1;
+
+  // @returns true iff the block of @p trailer has a compact free stack.
+  static bool HasCompactFreeStack(const BlockTrailer* trailer) {
+    return (trailer->free_stack_id & kCompactFreeStackTag) != 0;
+  }
+
   // Magic number to identify the beginning of a block header.
   static const size_t kBlockHeaderSignature = 0xCA80;
 
+  // Blocks evicted from the quarantine are kept in lock-free caches, one per
+  // allocation size, so that they may be handed out again without going
+  // through the underlying heap. Cached blocks are overlaid with this
+  // structure.
+  struct CachedBlock {
+    // Overlays the magic number of the block header. This is always zero so
+    // that cached blocks are never mistaken for live ones by FindAddressBlock.
+    uint32 magic_number;
+    // Ensures that list_entry respects the alignment required by the
+    // interlocked singly linked list functions.
+    uint32 reserved;
+    // The link in the cache list.
+    SLIST_ENTRY list_entry;
+  };
+  COMPILE_ASSERT(
+      (offsetof(CachedBlock, list_entry) % MEMORY_ALLOCATION_ALIGNMENT) == 0,
+      asan_cached_block_list_entry_misaligned);
+
+  // The granularity of the block cache size classes. All allocation sizes
+  // are a multiple of the shadow granularity, so each size class holds blocks
+  // of exactly one size, and these are interchangeable.
+  static const size_t kBlockCacheGranularity = 8;
+  // Blocks of an allocation size larger than this aren't cached.
+  static const size_t kBlockCacheMaxBlockSize = 1024;
+  // The number of block cache size classes.
+  static const size_t kBlockCacheSizeClasses =
+      kBlockCacheMaxBlockSize / kBlockCacheGranularity;
+  // The maximum number of blocks kept in each size class.
+  static const size_t kBlockCacheMaxDepth = 32;
+
+  // Allocations larger than large_allocation_threshold_ bypass the underlying
+  // heap and get pages of their own, which are released as soon as they're
+  // evicted from the quarantine:
+  //
+  // +------------+---------+----------------+------------+------------+
+  // | Guard page | Padding | LargeBlockInfo | ASan block | Guard page |
+  // +------------+---------+----------------+------------+------------+
+  //
+  // The ASan block ends right before the trailing guard page, so overflows
+  // past its trailer fault. The guard pages are only reserved, and their
+  // shadow memory is poisoned along with the padding.
+  struct LargeBlockInfo {
+    // The link in the list of large blocks of the heap.
+    LIST_ENTRY list_entry;
+    // The size of the whole region, guard pages included.
+    size_t region_size;
+  };
+
+  // The size of the pages of the large blocks.
+  static const size_t kLargeBlockPageSize = 4096;
+
+  // @name Large block management.
+  // @{
+  // Allocates a large block.
+  // @param alloc_size The size of the ASan block.
+  // @returns the ASan pointer of the block, or NULL on failure.
+  uint8* AllocLargeBlock(size_t alloc_size);
+  // Releases the pages of a large block.
+  // @param header The header of the block. Its metadata must have been
+  //     cleaned up.
+  void ReleaseLargeBlock(BlockHeader* header);
+  // Finds the large block containing @p addr, guard pages included.
+  // @param addr The address.
+  // @returns the header of the block, or NULL if there's none.
+  BlockHeader* FindLargeBlock(const void* addr);
+  // @returns the information about the large block @p header.
+  static LargeBlockInfo* BlockHeaderToLargeBlockInfo(
+      const BlockHeader* header);
+  // @returns the beginning of the region of the large block @p info.
+  static uint8* LargeBlockInfoToRegion(const LargeBlockInfo* info);
+  // @}
+
   // Initialize an ASan block. This will red-zone the header and trailer, green
   // zone the user data, and save the allocation stack trace and other metadata.
   // @param asan_pointer The ASan block to initialize.
@@ -222,6 +415,19 @@ class HeapProxy {
   static bool MarkBlockAsQuarantined(BlockHeader* block_header,
                                      const StackCapture& stack);
 
+  // Resizes an allocated block without moving it. The block keeps its
+  // footprint, so this only succeeds if the new user size and the trailer
+  // fit in it with an adaptive padding that can be recorded in the header.
+  // The bytes trimmed from the block are red-zoned.
+  // @param block_header The header of the block.
+  // @param bytes The new user size of the block.
+  // @param flags The flags of the reallocation, HEAP_ZERO_MEMORY is honored
+  //     for the bytes that the block gains.
+  // @returns true on success, false if the block has to be moved.
+  static bool ResizeBlockInPlace(BlockHeader* block_header,
+                                 size_t bytes,
+                                 DWORD flags);
+
   // Clean up the metadata of an ASan block.
   // @param block_header The header of the block.
   // @param block_header The trailer of the block.
@@ -272,6 +478,24 @@ class HeapProxy {
   // bytes, with an alignment of @p alignment bytes.
   static size_t GetAllocSize(size_t bytes, size_t alignment);
 
+  // Calculates the underlying allocation size of an existing block. This
+  // uses the adaptive padding the block has been allocated with.
+  // @param header The header of the block.
+  // @returns the underlying allocation size of the block.
+  static size_t GetBlockAllocSize(const BlockHeader* header);
+
+  // Calculates the underlying allocation size for an allocation of @p bytes
+  // with an alignment of @p alignment bytes, and an adaptive padding of
+  // 1 << @p adaptive_padding_log bytes.
+  static size_t ComputeAllocSize(size_t bytes,
+                                 size_t alignment,
+                                 size_t adaptive_padding_log);
+
+  // Picks the adaptive padding of the trailer of a block.
+  // @param bytes The user size of the block.
+  // @returns the log of the padding, or zero if the block gets none.
+  static size_t GetAdaptivePaddingLog(size_t bytes);
+
   // Find the memory block containing @p addr.
   // @returns a pointer to this memory block in case of success, NULL otherwise.
   BlockHeader* FindAddressBlock(const void* addr);
@@ -281,12 +505,100 @@ class HeapProxy {
   // @param header The header of the block containing this address.
   BadAccessKind GetBadAccessKind(const void* addr, BlockHeader* header);
 
-  // Quarantines @p block and flushes quarantine overage.
-  void QuarantineBlock(BlockHeader* block);
+  // The full free stack of a recently quarantined block with a compact free
+  // stack.
+  struct RecentFreeStack {
+    RecentFreeStack() : block(NULL) {
+    }
 
-  // If the quarantine size is over quarantine_max_size_, trim it down until
-  // it's below the limit.
-  void TrimQuarantine();
+    const BlockHeader* block;
+    StackCapture stack;
+  };
+
+  // The number of full free stacks each quarantine shard keeps.
+  static const size_t kRecentFreeStacksPerShard = 16;
+
+  // The quarantine is split into shards, each with its own lock and its own
+  // share of the quarantine byte budget. Threads quarantine the blocks they
+  // free into the shard their thread id hashes to, so concurrent frees don't
+  // all serialize on a single lock.
+  struct QuarantineShard {
+    QuarantineShard()
+        : head(NULL), tail(NULL), size(0), next_recent_free_stack(0) {
+    }
+
+    // Protects the shard.
+    base::Lock lock;
+    // Points to the head of the shard's quarantine queue.
+    BlockHeader* head;  // Under lock.
+    // Points to the tail of the shard's quarantine queue.
+    BlockHeader* tail;  // Under lock.
+    // Total size of the blocks in this shard.
+    size_t size;  // Under lock.
+    // The full free stacks of the blocks with compact free stacks most
+    // recently quarantined in this shard, used circularly. Under lock.
+    RecentFreeStack recent_free_stacks[kRecentFreeStacksPerShard];
+    size_t next_recent_free_stack;  // Under lock.
+  };
+
+  // The number of quarantine shards.
+  static const size_t kQuarantineShardCount = 8;
+
+  // When a freed block doesn't fit in the quarantine, the quarantine is
+  // trimmed down to this fraction of its maximum size below what the block
+  // needs in one go, so that the following frees don't each have to do it.
+  static const size_t kQuarantineTrimSlackDivisor = 16;
+
+  // Quarantines @p block, first evicting older blocks if that's needed to
+  // keep the quarantine within its maximum size. A block larger than the
+  // maximum size is released immediately.
+  // @param block The block to quarantine.
+  // @param free_stack The free stack of the block, which is kept in full if
+  //     the block has a compact free stack.
+  void QuarantineBlock(BlockHeader* block, const StackCapture& free_stack);
+
+  // Atomically adds @p size to the total quarantine size, unless this would
+  // take it over @p max_size.
+  // @param size The size to reserve, in bytes.
+  // @param max_size The maximum size of the quarantine, in bytes.
+  // @returns true if the size was reserved, false otherwise.
+  bool ReserveQuarantineSize(size_t size, size_t max_size);
+
+  // Returns the quarantine shard the blocks freed by the current thread go
+  // to.
+  size_t GetQuarantineShardIndex();
+
+  // If the quarantine size is over @p target_size, trim it down until it's
+  // below that. Blocks are first evicted from the shards that are over their
+  // share of the budget, and from any shard after that. In both cases the
+  // current thread's shard comes last.
+  // @param target_size The size to which to trim the quarantine, in bytes.
+  void TrimQuarantine(size_t target_size);
+
+  // Detaches the oldest blocks of a shard until either the total quarantine
+  // size is no greater than @p target_size or the shard size is no greater
+  // than @p shard_floor.
+  // @param shard The shard to trim.
+  // @param target_size The size to which to trim the quarantine, in bytes.
+  // @param shard_floor The size below which the shard isn't trimmed, in bytes.
+  // @returns the list of the detached blocks, linked by their trailers.
+  BlockHeader* TrimQuarantineShard(QuarantineShard* shard,
+                                   size_t target_size,
+                                   size_t shard_floor);
+
+  // Cleans up and releases a list of blocks evicted from the quarantine.
+  // @param evicted_blocks The blocks to release, linked by their trailers.
+  void ReleaseEvictedBlocks(BlockHeader* evicted_blocks);
+
+  // Finds the full free stack of a block with a compact free stack, to be
+  // called with all of the quarantine shard locks held.
+  // @param header The header of the block.
+  // @returns the free stack, or NULL if it's no longer kept.
+  const StackCapture* FindRecentFreeStackUnlocked(const BlockHeader* header);
+
+  // The implementation of GetBadAccessInformation, to be called with all of
+  // the quarantine shard locks held.
+  bool GetBadAccessInformationUnlocked(AsanErrorInfo* bad_access_info);
 
   // Get the information about an address relative to a block.
   // @param header The header of the block containing this address.
@@ -297,6 +609,23 @@ class HeapProxy {
   // Returns the time since the block @p header was freed (in microseconds).
   uint64 GetTimeSinceFree(const BlockHeader* header);
 
+  // @name Block cache management.
+  // @{
+  // Pops a block of exactly @p alloc_size bytes from the cache.
+  // @param alloc_size The underlying allocation size of the block.
+  // @returns a block on success, NULL if there is no cached block of this
+  //     size.
+  uint8* PopCachedBlock(size_t alloc_size);
+  // Releases a block that has been evicted from the quarantine. It is cached
+  // if there's room for it, and returned to the underlying heap otherwise.
+  // @param block The block to release. Its metadata must have been cleaned up
+  //     and its shadow memory unpoisoned.
+  // @param alloc_size The underlying allocation size of the block.
+  void ReleaseEvictedBlock(uint8* block, size_t alloc_size);
+  // Returns all of the cached blocks to the underlying heap.
+  void FlushBlockCache();
+  // @}
+
   // Arbitrarily keep 16 megabytes of quarantine per heap by default.
   static const size_t kDefaultQuarantineMaxSize = 16 * 1024 * 1024;
 
@@ -304,6 +633,14 @@ class HeapProxy {
   // header and footer.
   static const size_t kDefaultTrailerPaddingSize = 0;
 
+  // The adaptive redzones are disabled by default. When they're enabled they
+  // stop growing at 2 kilobytes by default.
+  static const size_t kDefaultAdaptiveRedzoneRatio = 0;
+  static const size_t kDefaultMaxRedzoneSize = 2048;
+
+  // Allocations of more than a megabyte bypass the underlying heap by default.
+  static const size_t kDefaultLargeAllocationThreshold = 1024 * 1024;
+
   // The default alloc granularity. The Windows heap is 8-byte granular, so
   // there's no gain in a lower allocation granularity.
   static const size_t kDefaultAllocGranularity = 8;
@@ -316,6 +653,25 @@ class HeapProxy {
   // to zero.
   static size_t trailer_padding_size_;
 
+  // The maximum depths of the stack traces captured on allocation and on
+  // free. Both default to StackCapture::kMaxNumFrames.
+  static size_t alloc_stack_depth_;
+  static size_t free_stack_depth_;
+
+  // Whether the blocks quarantined from now on get compact free stacks.
+  static bool compact_free_stacks_;
+
+  // The size above which allocations bypass the underlying heap, or zero.
+  static size_t large_allocation_threshold_;
+
+  // The ratio of the allocation size the redzones aim for, or zero, and the
+  // size above which they don't grow.
+  static size_t adaptive_redzone_ratio_;
+  static size_t max_redzone_size_;
+
+  // The per-allocation-site statistics, or NULL if sampling is disabled.
+  static AllocationSiteStats* allocation_site_stats_;
+
   // The number of CPU cycles per microsecond on the current machine.
   static double cpu_cycles_per_us_;
 
@@ -327,20 +683,29 @@ class HeapProxy {
   //     compression for the process with several heap.
   static StackCaptureCache* stack_cache_;
 
-  // Protects concurrent access to HeapProxy internals.
-  base::Lock lock_;
+  // The quarantine shards, indexed by GetQuarantineShardIndex. When several
+  // shard locks are held they're always acquired in increasing index order.
+  QuarantineShard quarantine_shards_[kQuarantineShardCount];
+
+  // Total size of blocks in quarantine, over all of the shards. This is only
+  // ever modified with interlocked operations, and never exceeds the maximum
+  // size the blocks were quarantined with.
+  volatile LONG quarantine_size_;
 
-  // Points to the head of the quarantine queue.
-  BlockHeader* head_;  // Under lock_.
+  // Max size of blocks in quarantine. This is read without synchronization;
+  // a concurrent free may still check its block against the previous value.
+  volatile size_t quarantine_max_size_;
 
-  // Points to the tail of the quarantine queue.
-  BlockHeader* tail_;  // Under lock_.
+  // The size-classed caches of evicted blocks, indexed by allocation size
+  // divided by kBlockCacheGranularity, minus one. These are lock-free.
+  SLIST_HEADER block_cache_[kBlockCacheSizeClasses];
 
-  // Total size of blocks in quarantine.
-  size_t quarantine_size_;  // Under lock_.
+  // Protects the list of large blocks.
+  base::Lock large_blocks_lock_;
 
-  // Max size of blocks in quarantine.
-  size_t quarantine_max_size_;  // Under lock_.
+  // The large blocks of this heap, linked by their LargeBlockInfo. When
+  // the quarantine shard locks are also held, this lock is acquired last.
+  LIST_ENTRY large_blocks_;  // Under large_blocks_lock_.
 
   // The entry linking to us.
   LIST_ENTRY list_entry_;
@@ -15,11 +15,14 @@
 #include "syzygy/agent/asan/asan_heap.h"
 
 #include <algorithm>
+#include <vector>
 
 #include "base/rand_util.h"
 #include "base/sha1.h"
 #include "gtest/gtest.h"
+#include "syzygy/agent/asan/allocation_site_stats.h"
 #include "syzygy/agent/asan/asan_logger.h"
+#include "syzygy/agent/asan/asan_runtime.h"
 #include "syzygy/agent/asan/asan_shadow.h"
 #include "syzygy/agent/asan/unittest_util.h"
 #include "syzygy/common/align.h"
@@ -48,14 +51,18 @@ class TestHeapProxy : public HeapProxy {
   using HeapProxy::BlockHeaderToUserPointer;
   using HeapProxy::FindAddressBlock;
   using HeapProxy::GetAllocSize;
+  using HeapProxy::GetBlockAllocSize;
   using HeapProxy::GetBadAccessKind;
   using HeapProxy::GetTimeSinceFree;
+  using HeapProxy::HasCompactFreeStack;
   using HeapProxy::InitializeAsanBlock;
   using HeapProxy::MarkBlockAsQuarantined;
   using HeapProxy::ReleaseASanBlock;
   using HeapProxy::UserPointerToBlockHeader;
   using HeapProxy::UserPointerToAsanPointer;
   using HeapProxy::kDefaultAllocGranularityLog;
+  using HeapProxy::kLargeBlockPageSize;
+  using HeapProxy::kQuarantineShardCount;
 
   TestHeapProxy() { }
 
@@ -93,20 +100,40 @@ class TestHeapProxy : public HeapProxy {
 
   // Determines if the address @p mem corresponds to a block in quarantine.
   bool InQuarantine(const void* mem) {
-    base::AutoLock lock(lock_);
-    BlockHeader* current_block = head_;
-    while (current_block != NULL) {
-      void* block_alloc = static_cast<void*>(
-          BlockHeaderToUserPointer(current_block));
-      EXPECT_TRUE(block_alloc != NULL);
-      if (block_alloc == mem) {
-        EXPECT_TRUE(current_block->state == QUARANTINED);
-        return true;
+    for (size_t i = 0; i < kQuarantineShardCount; ++i) {
+      base::AutoLock lock(quarantine_shards_[i].lock);
+      BlockHeader* current_block = quarantine_shards_[i].head;
+      while (current_block != NULL) {
+        void* block_alloc = static_cast<void*>(
+            BlockHeaderToUserPointer(current_block));
+        EXPECT_TRUE(block_alloc != NULL);
+        if (block_alloc == mem) {
+          EXPECT_TRUE(current_block->state == QUARANTINED);
+          return true;
+        }
+        current_block =
+            BlockHeaderToBlockTrailer(current_block)->next_free_block;
       }
-      current_block = BlockHeaderToBlockTrailer(current_block)->next_free_block;
     }
     return false;
   }
+
+  // Returns the total size of the quarantine, without synchronizing with the
+  // concurrent frees.
+  size_t UnsynchronizedQuarantineSize() {
+    return static_cast<size_t>(quarantine_size_);
+  }
+
+  // Returns the total size of the quarantine, computed from its shards.
+  size_t QuarantineSize() {
+    size_t size = 0;
+    for (size_t i = 0; i < kQuarantineShardCount; ++i) {
+      base::AutoLock lock(quarantine_shards_[i].lock);
+      size += quarantine_shards_[i].size;
+    }
+    EXPECT_EQ(static_cast<size_t>(quarantine_size_), size);
+    return size;
+  }
 };
 
 class HeapTest : public testing::TestWithAsanLogger {
@@ -262,17 +289,64 @@ TEST_F(HeapTest, Realloc) {
   mem = proxy_.ReAlloc(0, mem, kAllocSize + 5);
   ASSERT_TRUE(mem != NULL);
 
-  // We always fail reallocs with the in-place flag.
+  // In-place reallocations fail if there's no block, or if the block can't
+  // hold the new size.
   ASSERT_EQ(NULL,
             proxy_.ReAlloc(HEAP_REALLOC_IN_PLACE_ONLY, NULL, kAllocSize));
-  ASSERT_EQ(NULL,
-            proxy_.ReAlloc(HEAP_REALLOC_IN_PLACE_ONLY, mem, kAllocSize - 10));
   ASSERT_EQ(NULL,
             proxy_.ReAlloc(HEAP_REALLOC_IN_PLACE_ONLY, mem, kAllocSize + 10));
 
   ASSERT_TRUE(proxy_.Free(0, mem));
 }
 
+TEST_F(HeapTest, ReallocInPlace) {
+  // With the header and the trailer, this makes a 136 byte block.
+  const size_t kAllocSize = 100;
+  uint8* mem = reinterpret_cast<uint8*>(proxy_.Alloc(0, kAllocSize));
+  ASSERT_TRUE(mem != NULL);
+  size_t alloc_size = TestHeapProxy::GetAllocSize(kAllocSize);
+  TestHeapProxy::BlockHeader* header = proxy_.UserPointerToBlockHeader(mem);
+
+  // Shrinking within the shadow granularity leaves the footprint as is.
+  ASSERT_EQ(mem, proxy_.ReAlloc(HEAP_REALLOC_IN_PLACE_ONLY, mem,
+                                kAllocSize - 2));
+  EXPECT_EQ(kAllocSize - 2, proxy_.Size(0, mem));
+  EXPECT_TRUE(Shadow::IsAccessible(mem + kAllocSize - 3));
+  EXPECT_FALSE(Shadow::IsAccessible(mem + kAllocSize - 2));
+  EXPECT_EQ(alloc_size, TestHeapProxy::GetBlockAllocSize(header));
+
+  // Growing back into the slack zeroes the bytes the block gains.
+  mem[kAllocSize - 2] = 0xAA;
+  ASSERT_EQ(mem, proxy_.ReAlloc(HEAP_ZERO_MEMORY, mem, kAllocSize));
+  EXPECT_EQ(kAllocSize, proxy_.Size(0, mem));
+  EXPECT_TRUE(Shadow::IsAccessible(mem + kAllocSize - 1));
+  EXPECT_EQ(0, mem[kAllocSize - 2]);
+
+  // Trimming 8 and then 16 bytes from the footprint turns them into padding,
+  // which stays red-zoned.
+  ASSERT_EQ(mem, proxy_.ReAlloc(0, mem, kAllocSize - 8));
+  EXPECT_FALSE(Shadow::IsAccessible(mem + kAllocSize - 8));
+  EXPECT_EQ(alloc_size, TestHeapProxy::GetBlockAllocSize(header));
+  ASSERT_EQ(mem, proxy_.ReAlloc(0, mem, kAllocSize - 20));
+  EXPECT_TRUE(Shadow::IsAccessible(mem + kAllocSize - 21));
+  EXPECT_FALSE(Shadow::IsAccessible(mem + kAllocSize - 20));
+  EXPECT_EQ(alloc_size, TestHeapProxy::GetBlockAllocSize(header));
+
+  // The trailer is still found past the end of the user data.
+  ASSERT_EQ(NULL,
+            proxy_.BlockHeaderToBlockTrailer(header)->next_free_block);
+
+  // This leaves 40 bytes of padding, which the header can't describe.
+  ASSERT_EQ(NULL,
+            proxy_.ReAlloc(HEAP_REALLOC_IN_PLACE_ONLY, mem, kAllocSize - 40));
+  uint8* new_mem = reinterpret_cast<uint8*>(
+      proxy_.ReAlloc(0, mem, kAllocSize - 40));
+  ASSERT_TRUE(new_mem != NULL);
+  EXPECT_NE(mem, new_mem);
+
+  ASSERT_TRUE(proxy_.Free(0, new_mem));
+}
+
 TEST_F(HeapTest, AllocFree) {
   const size_t kAllocSize = 100;
   LPVOID mem = proxy_.Alloc(0, kAllocSize);
@@ -418,6 +492,188 @@ TEST_F(HeapTest, FindAddressBlock) {
   ASSERT_TRUE(proxy_.Free(0, mem));
 }
 
+TEST_F(HeapTest, EvictedBlocksAreReused) {
+  const size_t kAllocSize = 100;
+  // Disable the quarantine so that freed blocks are immediately evicted.
+  proxy_.SetQuarantineMaxSize(0);
+
+  void* mem = proxy_.Alloc(0, kAllocSize);
+  ASSERT_TRUE(mem != NULL);
+  memset(mem, 0xAB, kAllocSize);
+  ASSERT_TRUE(proxy_.Free(0, mem));
+  ASSERT_FALSE(proxy_.InQuarantine(mem));
+
+  // The evicted block is no longer recognized as a live block.
+  ASSERT_TRUE(proxy_.FindAddressBlock(mem) == NULL);
+
+  // An allocation of a different size doesn't get the cached block.
+  void* mem2 = proxy_.Alloc(0, 2 * kAllocSize);
+  ASSERT_TRUE(mem2 != NULL);
+  EXPECT_NE(mem, mem2);
+
+  // An allocation of the same size does, and it is initialized like a fresh
+  // one.
+  void* mem3 = proxy_.Alloc(HEAP_ZERO_MEMORY, kAllocSize);
+  ASSERT_EQ(mem, mem3);
+  ASSERT_NO_FATAL_FAILURE(VerifyAllocAccess(mem3, kAllocSize));
+  for (size_t i = 0; i < kAllocSize; ++i)
+    EXPECT_EQ(0, static_cast<const uint8*>(mem3)[i]);
+
+  ASSERT_TRUE(proxy_.Free(0, mem2));
+  ASSERT_TRUE(proxy_.Free(0, mem3));
+}
+
+TEST_F(HeapTest, TrimQuarantineEvictsSeveralBlocks) {
+  const size_t kAllocSize = 100;
+  const size_t kNumAllocs = 8;
+  const size_t real_alloc_size = TestHeapProxy::GetAllocSize(kAllocSize);
+  proxy_.SetQuarantineMaxSize(real_alloc_size * kNumAllocs);
+
+  void* mem[kNumAllocs] = {};
+  for (size_t i = 0; i < kNumAllocs; ++i) {
+    mem[i] = proxy_.Alloc(0, kAllocSize);
+    ASSERT_TRUE(mem[i] != NULL);
+    ASSERT_TRUE(proxy_.Free(0, mem[i]));
+  }
+  for (size_t i = 0; i < kNumAllocs; ++i)
+    ASSERT_TRUE(proxy_.InQuarantine(mem[i]));
+
+  // Shrinking the quarantine evicts the oldest blocks in one go.
+  proxy_.SetQuarantineMaxSize(real_alloc_size * 2);
+  for (size_t i = 0; i < kNumAllocs - 2; ++i)
+    EXPECT_FALSE(proxy_.InQuarantine(mem[i]));
+  EXPECT_TRUE(proxy_.InQuarantine(mem[kNumAllocs - 2]));
+  EXPECT_TRUE(proxy_.InQuarantine(mem[kNumAllocs - 1]));
+}
+
+namespace {
+
+// The parameters of a thread freeing a block.
+struct FreeThreadParams {
+  HeapProxy* proxy;
+  void* mem;
+};
+
+DWORD WINAPI FreeThreadMain(void* param) {
+  FreeThreadParams* params = reinterpret_cast<FreeThreadParams*>(param);
+  return params->proxy->Free(0, params->mem) ? 0 : 1;
+}
+
+// The parameters of a thread freeing blocks at the same time as others.
+struct ConcurrentFreeThreadParams {
+  TestHeapProxy* proxy;
+  HANDLE start_event;
+  void** mem;
+  size_t num_blocks;
+  size_t max_quarantine_size;
+};
+
+DWORD WINAPI ConcurrentFreeThreadMain(void* param) {
+  ConcurrentFreeThreadParams* params =
+      reinterpret_cast<ConcurrentFreeThreadParams*>(param);
+  if (::WaitForSingleObject(params->start_event, INFINITE) != WAIT_OBJECT_0)
+    return 1;
+
+  for (size_t i = 0; i < params->num_blocks; ++i) {
+    if (!params->proxy->Free(0, params->mem[i]))
+      return 1;
+    if (params->proxy->UnsynchronizedQuarantineSize() >
+            params->max_quarantine_size) {
+      return 2;
+    }
+  }
+  return 0;
+}
+
+}  // namespace
+
+TEST_F(HeapTest, QuarantineSizeIsBoundedAcrossThreads) {
+  const size_t kAllocSize = 100;
+  const size_t kNumThreads = 2 * TestHeapProxy::kQuarantineShardCount;
+  const size_t kMaxBlocks = 4;
+  const size_t real_alloc_size = TestHeapProxy::GetAllocSize(kAllocSize);
+  proxy_.SetQuarantineMaxSize(real_alloc_size * kMaxBlocks);
+
+  // Free the blocks on as many threads, so that they end up scattered over
+  // the quarantine shards.
+  void* mem[kNumThreads] = {};
+  for (size_t i = 0; i < kNumThreads; ++i) {
+    mem[i] = proxy_.Alloc(0, kAllocSize);
+    ASSERT_TRUE(mem[i] != NULL);
+
+    FreeThreadParams params = { &proxy_, mem[i] };
+    HANDLE thread = ::CreateThread(NULL, 0, &FreeThreadMain, &params, 0, NULL);
+    ASSERT_TRUE(thread != NULL);
+    ASSERT_EQ(WAIT_OBJECT_0, ::WaitForSingleObject(thread, INFINITE));
+    DWORD exit_code = 0;
+    EXPECT_TRUE(::GetExitCodeThread(thread, &exit_code) == TRUE);
+    EXPECT_EQ(0u, exit_code);
+    ::CloseHandle(thread);
+
+    // The most recently freed block is always kept.
+    EXPECT_TRUE(proxy_.InQuarantine(mem[i]));
+    EXPECT_LE(proxy_.QuarantineSize(), real_alloc_size * kMaxBlocks);
+  }
+
+  size_t quarantined_blocks = 0;
+  for (size_t i = 0; i < kNumThreads; ++i) {
+    if (proxy_.InQuarantine(mem[i]))
+      ++quarantined_blocks;
+  }
+  EXPECT_LE(quarantined_blocks, kMaxBlocks);
+  EXPECT_EQ(quarantined_blocks * real_alloc_size, proxy_.QuarantineSize());
+
+  // Shrinking the quarantine trims all of the shards.
+  proxy_.SetQuarantineMaxSize(0);
+  EXPECT_EQ(0u, proxy_.QuarantineSize());
+  for (size_t i = 0; i < kNumThreads; ++i)
+    EXPECT_FALSE(proxy_.InQuarantine(mem[i]));
+}
+
+TEST_F(HeapTest, QuarantineSizeIsBoundedUnderConcurrentFrees) {
+  const size_t kAllocSize = 100;
+  const size_t kNumThreads = 2 * TestHeapProxy::kQuarantineShardCount;
+  const size_t kBlocksPerThread = 64;
+  const size_t kMaxBlocks = 4;
+  const size_t real_alloc_size = TestHeapProxy::GetAllocSize(kAllocSize);
+  const size_t max_quarantine_size = real_alloc_size * kMaxBlocks;
+  proxy_.SetQuarantineMaxSize(max_quarantine_size);
+
+  std::vector<void*> mem(kNumThreads * kBlocksPerThread);
+  for (size_t i = 0; i < mem.size(); ++i) {
+    mem[i] = proxy_.Alloc(0, kAllocSize);
+    ASSERT_TRUE(mem[i] != NULL);
+  }
+
+  // All of the threads free their blocks at once, and check that the
+  // quarantine never goes over its maximum size.
+  HANDLE start_event = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+  ASSERT_TRUE(start_event != NULL);
+  ConcurrentFreeThreadParams params[kNumThreads] = {};
+  HANDLE threads[kNumThreads] = {};
+  for (size_t i = 0; i < kNumThreads; ++i) {
+    ConcurrentFreeThreadParams thread_params = {
+        &proxy_, start_event, &mem[i * kBlocksPerThread], kBlocksPerThread,
+        max_quarantine_size };
+    params[i] = thread_params;
+    threads[i] = ::CreateThread(NULL, 0, &ConcurrentFreeThreadMain,
+                                &params[i], 0, NULL);
+    ASSERT_TRUE(threads[i] != NULL);
+  }
+  ASSERT_TRUE(::SetEvent(start_event) == TRUE);
+  ASSERT_EQ(WAIT_OBJECT_0,
+            ::WaitForMultipleObjects(kNumThreads, threads, TRUE, INFINITE));
+  for (size_t i = 0; i < kNumThreads; ++i) {
+    DWORD exit_code = 0;
+    EXPECT_TRUE(::GetExitCodeThread(threads[i], &exit_code) == TRUE);
+    EXPECT_EQ(0u, exit_code);
+    ::CloseHandle(threads[i]);
+  }
+  ::CloseHandle(start_event);
+
+  EXPECT_LE(proxy_.QuarantineSize(), max_quarantine_size);
+}
+
 TEST_F(HeapTest, GetBadAccessKind) {
   const size_t kAllocSize = 100;
   // Ensure that the quarantine is large enough to keep this block, this is
@@ -590,6 +846,179 @@ TEST_F(HeapTest, SetTrailerPaddingSize) {
   proxy_.set_trailer_padding_size(original_trailer_padding_size);
 }
 
+TEST_F(HeapTest, LargeAllocation) {
+  const size_t kAllocSize = 100;
+  TestHeapProxy::set_large_allocation_threshold(kAllocSize - 1);
+  // Ensure that the quarantine is large enough to keep this block.
+  proxy_.SetQuarantineMaxSize(TestHeapProxy::GetAllocSize(kAllocSize));
+
+  uint8* mem = static_cast<uint8*>(proxy_.Alloc(HEAP_ZERO_MEMORY, kAllocSize));
+  ASSERT_TRUE(mem != NULL);
+  const TestHeapProxy::BlockHeader* header =
+      proxy_.UserPointerToBlockHeader(mem);
+  ASSERT_TRUE(header != NULL);
+  EXPECT_TRUE(header->large_block);
+  VerifyAllocAccess(mem, kAllocSize);
+  EXPECT_EQ(kAllocSize, proxy_.Size(0, mem));
+  EXPECT_TRUE(proxy_.Validate(0, mem));
+
+  // The block ends right before a guard page, whose shadow is poisoned.
+  uint8* block_end = reinterpret_cast<uint8*>(
+      const_cast<TestHeapProxy::BlockHeader*>(header)) +
+      TestHeapProxy::GetAllocSize(kAllocSize);
+  EXPECT_EQ(0U, reinterpret_cast<uintptr_t>(block_end) %
+                    TestHeapProxy::kLargeBlockPageSize);
+  MEMORY_BASIC_INFORMATION info = {};
+  ASSERT_EQ(sizeof(info), ::VirtualQuery(block_end, &info, sizeof(info)));
+  EXPECT_EQ(MEM_RESERVE, info.State);
+  EXPECT_EQ(Shadow::kHeapRightRedzone,
+            Shadow::GetShadowMarkerForAddress(block_end));
+  EXPECT_EQ(header, proxy_.FindAddressBlock(block_end));
+
+  // Freeing the block quarantines it, and evicting it releases its pages.
+  ASSERT_TRUE(proxy_.Free(0, mem));
+  EXPECT_TRUE(proxy_.InQuarantine(mem));
+  VerifyFreedAccess(mem, kAllocSize);
+  proxy_.SetQuarantineMaxSize(0);
+  ASSERT_EQ(sizeof(info), ::VirtualQuery(mem, &info, sizeof(info)));
+  EXPECT_EQ(MEM_FREE, info.State);
+  EXPECT_TRUE(Shadow::IsAccessible(mem));
+  EXPECT_TRUE(Shadow::IsAccessible(block_end));
+}
+
+TEST_F(HeapTest, AdaptiveRedzones) {
+  const size_t kFixedRedzoneSize = sizeof(TestHeapProxy::BlockHeader) +
+      sizeof(TestHeapProxy::BlockTrailer);
+  const size_t kMaxRedzoneSize = 256;
+  TestHeapProxy::set_adaptive_redzone_ratio(4);
+  TestHeapProxy::set_max_redzone_size(kMaxRedzoneSize);
+
+  // The tiny blocks only get the header and the trailer, the larger ones
+  // get padded up to the maximum redzone size.
+  const size_t kSizes[] = { 16, 300, 1000, 4096, 100000 };
+  for (size_t i = 0; i < arraysize(kSizes); ++i) {
+    size_t size = kSizes[i];
+    uint8* mem = static_cast<uint8*>(proxy_.Alloc(0, size));
+    ASSERT_TRUE(mem != NULL);
+    TestHeapProxy::BlockHeader* header = proxy_.UserPointerToBlockHeader(mem);
+    size_t alloc_size = TestHeapProxy::GetBlockAllocSize(header);
+    EXPECT_EQ(TestHeapProxy::GetAllocSize(size), alloc_size);
+
+    size_t target_size = std::min(size / 4, kMaxRedzoneSize);
+    size_t redzone_size = alloc_size - size;
+    if (target_size <= kFixedRedzoneSize) {
+      EXPECT_EQ(0U, header->adaptive_padding_log);
+      EXPECT_EQ(common::AlignUp(size + kFixedRedzoneSize,
+                                Shadow::kShadowGranularity),
+                alloc_size);
+    } else {
+      EXPECT_LE(target_size, redzone_size);
+      EXPECT_GE(2 * target_size + Shadow::kShadowGranularity, redzone_size);
+    }
+
+    // The whole trailer is poisoned, and the bad accesses past the end of
+    // the block are still reported as overflows.
+    VerifyAllocAccess(mem, size);
+    uint8* last_redzone_byte =
+        reinterpret_cast<uint8*>(header) + alloc_size - 1;
+    EXPECT_FALSE(Shadow::IsAccessible(last_redzone_byte));
+    EXPECT_TRUE(proxy_.IsOverflowAccess(last_redzone_byte, header));
+
+    ASSERT_TRUE(proxy_.Free(0, mem));
+  }
+
+  TestHeapProxy::set_adaptive_redzone_ratio(0);
+}
+
+TEST_F(HeapTest, AllocationSiteStats) {
+  const size_t kAllocSize = 100;
+  AllocationSiteStats stats(1);
+  HeapProxy::set_allocation_site_stats(&stats);
+  // Ensure that the quarantine is large enough to keep the block.
+  proxy_.SetQuarantineMaxSize(TestHeapProxy::GetAllocSize(kAllocSize));
+
+  void* mem = proxy_.Alloc(0, kAllocSize);
+  ASSERT_TRUE(mem != NULL);
+  TestHeapProxy::BlockHeader* header = proxy_.UserPointerToBlockHeader(mem);
+  EXPECT_TRUE(header->sampled);
+  size_t redzone_size = TestHeapProxy::GetAllocSize(kAllocSize) - kAllocSize;
+
+  AllocationSiteStats::SiteStatsVector sites;
+  stats.GetTopSites(1, &sites);
+  ASSERT_EQ(1U, sites.size());
+  EXPECT_EQ(header->alloc_stack->stack_id(), sites[0].stack_id);
+  EXPECT_EQ(1U, sites[0].live_blocks);
+  EXPECT_EQ(kAllocSize, sites[0].live_bytes);
+  EXPECT_EQ(redzone_size, sites[0].redzone_bytes);
+
+  // Freeing the block moves it to the quarantine...
+  ASSERT_TRUE(proxy_.Free(0, mem));
+  stats.GetTopSites(1, &sites);
+  ASSERT_EQ(1U, sites.size());
+  EXPECT_EQ(0U, sites[0].live_blocks);
+  EXPECT_EQ(1U, sites[0].quarantined_blocks);
+  EXPECT_EQ(TestHeapProxy::GetAllocSize(kAllocSize),
+            sites[0].quarantined_bytes);
+
+  // ... and evicting it forgets about it.
+  proxy_.SetQuarantineMaxSize(0);
+  stats.GetTopSites(1, &sites);
+  EXPECT_TRUE(sites.empty());
+
+  HeapProxy::set_allocation_site_stats(NULL);
+}
+
+TEST_F(HeapTest, StackDepths) {
+  TestHeapProxy::set_alloc_stack_depth(3);
+  TestHeapProxy::set_free_stack_depth(2);
+
+  const size_t kAllocSize = 13;
+  // Ensure that the quarantine is large enough to keep this block.
+  proxy_.SetQuarantineMaxSize(TestHeapProxy::GetAllocSize(kAllocSize));
+  uint8* mem = static_cast<uint8*>(proxy_.Alloc(0, kAllocSize));
+  ASSERT_TRUE(mem != NULL);
+  TestHeapProxy::BlockHeader* header =
+      const_cast<TestHeapProxy::BlockHeader*>(
+          proxy_.UserPointerToBlockHeader(mem));
+  ASSERT_TRUE(header != NULL);
+  ASSERT_TRUE(header->alloc_stack != NULL);
+  EXPECT_EQ(3U, header->alloc_stack->num_frames());
+
+  ASSERT_TRUE(proxy_.Free(0, mem));
+  TestHeapProxy::BlockTrailer* trailer =
+      proxy_.BlockHeaderToBlockTrailer(header);
+  ASSERT_TRUE(trailer->free_stack != NULL);
+  EXPECT_EQ(2U, trailer->free_stack->num_frames());
+}
+
+TEST_F(HeapTest, CompactFreeStacks) {
+  TestHeapProxy::set_compact_free_stacks(true);
+
+  const size_t kAllocSize = 13;
+  // Ensure that the quarantine is large enough to keep this block.
+  proxy_.SetQuarantineMaxSize(TestHeapProxy::GetAllocSize(kAllocSize));
+  uint8* mem = static_cast<uint8*>(proxy_.Alloc(0, kAllocSize));
+  ASSERT_TRUE(mem != NULL);
+  ASSERT_TRUE(proxy_.Free(0, mem));
+
+  const TestHeapProxy::BlockHeader* header =
+      proxy_.UserPointerToBlockHeader(mem);
+  ASSERT_TRUE(header != NULL);
+  const TestHeapProxy::BlockTrailer* trailer =
+      proxy_.BlockHeaderToBlockTrailer(header);
+  EXPECT_TRUE(TestHeapProxy::HasCompactFreeStack(trailer));
+
+  // The block has just been freed, so its full free stack is still kept.
+  AsanErrorInfo error_info = {};
+  error_info.location = mem;
+  error_info.error_type = HeapProxy::UNKNOWN_BAD_ACCESS;
+  EXPECT_TRUE(proxy_.GetBadAccessInformation(&error_info));
+  EXPECT_EQ(HeapProxy::USE_AFTER_FREE, error_info.error_type);
+  EXPECT_EQ(trailer->free_stack_id, error_info.free_stack_id);
+  EXPECT_LT(0U, error_info.free_stack_size);
+  EXPECT_EQ(::GetCurrentThreadId(), error_info.free_tid);
+}
+
 namespace {
 
 // A unittest fixture to test the bookkeeping functions.
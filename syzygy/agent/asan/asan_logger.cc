@@ -14,6 +14,8 @@
 
 #include "syzygy/agent/asan/asan_logger.h"
 
+#include <vector>
+
 #include "base/command_line.h"
 #include "base/environment.h"
 #include "base/logging.h"
@@ -52,19 +54,62 @@ void InitExecutionContext(const CONTEXT& rtl_context,
   exc_context->seg_ss = rtl_context.SegSs;
 }
 
+// Send a text @p message to the logger bound to @p binding.
+void WriteMessage(handle_t binding, const std::string& message) {
+  DCHECK(binding != NULL);
+  trace::client::InvokeRpc(
+      &LoggerClient_Write,
+      binding,
+      reinterpret_cast<const unsigned char*>(message.c_str()));
+}
+
 }  // namespace
 
-AsanLogger::AsanLogger() : log_as_text_(true), minidump_on_failure_(false) {
+struct AsanLogger::QueuedMessage {
+  // This must be the first field, the queue links the messages through it.
+  SLIST_ENTRY entry;
+  std::string message;
+  // The stack trace to send along with the message. Empty for the text
+  // messages, which are the ones that get batched together.
+  std::vector<DWORD> trace;
+};
+
+AsanLogger::AsanLogger()
+    : initialized_(false),
+      connect_attempted_(false),
+      log_as_text_(true),
+      minidump_on_failure_(false),
+      pending_event_(NULL),
+      pending_wait_(NULL) {
+  ::InitializeSListHead(&pending_messages_);
+}
+
+AsanLogger::~AsanLogger() {
+  StopBackgroundWriter();
+  Flush();
 }
 
 void AsanLogger::Init() {
+  initialized_ = true;
+}
+
+bool AsanLogger::EnsureConnected() {
+  if (connect_attempted_)
+    return rpc_binding_.Get() != NULL;
+  if (!initialized_)
+    return false;
+
+  base::AutoLock lock(connect_lock_);
+  if (connect_attempted_)
+    return rpc_binding_.Get() != NULL;
+
   bool success = rpc_binding_.Open(
       kLoggerRpcProtocol,
       GetInstanceString(kLoggerRpcEndpointRoot, instance_id_));
 
   // TODO(rogerm): Add a notion of a session to the logger interface. Opening
-  //     a session (either here, or on first use) allows for better management
-  //     of symbol context across trace log messages for a given process.
+  //     a session on first use allows for better management of symbol
+  //     context across trace log messages for a given process.
   if (success) {
     const CommandLine* command_line = CommandLine::ForCurrentProcess();
     std::string message = base::StringPrintf(
@@ -78,9 +123,39 @@ void AsanLogger::Init() {
     if (!success)
       rpc_binding_.Close();
   }
+
+  if (success) {
+    // Start the background writer. If this fails the messages will simply be
+    // sent synchronously.
+    DCHECK(pending_event_ == NULL);
+    DCHECK(pending_wait_ == NULL);
+    pending_event_ = ::CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (pending_event_ != NULL &&
+        !::RegisterWaitForSingleObject(&pending_wait_,
+                                       pending_event_,
+                                       &AsanLogger::OnMessagesPending,
+                                       this,
+                                       INFINITE,
+                                       WT_EXECUTELONGFUNCTION)) {
+      pending_wait_ = NULL;
+      ::CloseHandle(pending_event_);
+      pending_event_ = NULL;
+    }
+  }
+
+  // Publish the outcome only once the binding and the writer are set up.
+  connect_attempted_ = true;
+  return success;
 }
 
 void AsanLogger::Stop() {
+  // There's nothing to stop if nothing ever got written.
+  if (!connect_attempted_)
+    return;
+
+  StopBackgroundWriter();
+  Flush();
+
   if (rpc_binding_.Get() != NULL) {
     trace::client::InvokeRpc(
         &LoggerClient_Stop,
@@ -90,18 +165,20 @@ void AsanLogger::Stop() {
 
 void AsanLogger::Write(const std::string& message) {
   // If we're bound to a logging endpoint, log the message there.
-  if (rpc_binding_.Get() != NULL) {
-    trace::client::InvokeRpc(
-        &LoggerClient_Write,
-        rpc_binding_.Get(),
-        reinterpret_cast<const unsigned char*>(message.c_str()));
+  if (EnsureConnected()) {
+    QueuedMessage* queued_message = new QueuedMessage();
+    queued_message->message = message;
+    EnqueueMessage(queued_message);
   }
 }
 
 void AsanLogger::WriteWithContext(const std::string& message,
                                   const CONTEXT& context) {
-  // If we're bound to a logging endpoint, log the message there.
-  if (rpc_binding_.Get() != NULL) {
+  // If we're bound to a logging endpoint, log the message there. The logger
+  // walks the stack of this thread so this has to be synchronous, and the
+  // pending messages have to go first.
+  if (EnsureConnected()) {
+    Flush();
     ExecutionContext exec_context = {};
     InitExecutionContext(context, &exec_context);
     trace::client::InvokeRpc(
@@ -116,13 +193,12 @@ void AsanLogger::WriteWithStackTrace(const std::string& message,
                                      const void * const * trace_data,
                                      size_t trace_length) {
   // If we're bound to a logging endpoint, log the message there.
-  if (rpc_binding_.Get() != NULL) {
-    trace::client::InvokeRpc(
-        &LoggerClient_WriteWithTrace,
-        rpc_binding_.Get(),
-        reinterpret_cast<const unsigned char*>(message.c_str()),
-        reinterpret_cast<const DWORD*>(trace_data),
-        trace_length);
+  if (EnsureConnected()) {
+    QueuedMessage* queued_message = new QueuedMessage();
+    queued_message->message = message;
+    const DWORD* frames = reinterpret_cast<const DWORD*>(trace_data);
+    queued_message->trace.assign(frames, frames + trace_length);
+    EnqueueMessage(queued_message);
   }
 }
 
@@ -130,9 +206,12 @@ void AsanLogger::SaveMiniDump(CONTEXT* context, AsanErrorInfo* error_info) {
   DCHECK(context != NULL);
   DCHECK(error_info != NULL);
 
-  if (rpc_binding_.Get() == NULL)
+  if (!EnsureConnected())
     return;
 
+  // Make sure the log is complete before the dump gets taken.
+  Flush();
+
   EXCEPTION_RECORD exception = {};
   exception.ExceptionCode = EXCEPTION_ARRAY_BOUNDS_EXCEEDED;
   exception.ExceptionAddress = reinterpret_cast<PVOID>(context->Eip);
@@ -148,5 +227,91 @@ void AsanLogger::SaveMiniDump(CONTEXT* context, AsanErrorInfo* error_info) {
                            0);
 }
 
+void AsanLogger::Flush() {
+  base::AutoLock lock(flush_lock_);
+
+  // Grab all the pending messages at once and restore their FIFO order.
+  PSLIST_ENTRY entry = ::InterlockedFlushSList(&pending_messages_);
+  PSLIST_ENTRY head = NULL;
+  while (entry != NULL) {
+    PSLIST_ENTRY next = entry->Next;
+    entry->Next = head;
+    head = entry;
+    entry = next;
+  }
+
+  // Batch the consecutive text messages, the logger appends the missing
+  // trailing newlines itself so we do the same when concatenating them.
+  std::string batch;
+  while (head != NULL) {
+    scoped_ptr<QueuedMessage> queued_message(
+        reinterpret_cast<QueuedMessage*>(head));
+    head = head->Next;
+
+    if (rpc_binding_.Get() == NULL)
+      continue;
+
+    if (queued_message->trace.empty()) {
+      if (queued_message->message.empty())
+        continue;
+      batch.append(queued_message->message);
+      if (*batch.rbegin() != '\n')
+        batch.push_back('\n');
+      continue;
+    }
+
+    if (!batch.empty()) {
+      WriteMessage(rpc_binding_.Get(), batch);
+      batch.clear();
+    }
+    trace::client::InvokeRpc(
+        &LoggerClient_WriteWithTrace,
+        rpc_binding_.Get(),
+        reinterpret_cast<const unsigned char*>(
+            queued_message->message.c_str()),
+        &queued_message->trace[0],
+        queued_message->trace.size());
+  }
+
+  if (!batch.empty())
+    WriteMessage(rpc_binding_.Get(), batch);
+}
+
+void AsanLogger::EnqueueMessage(QueuedMessage* message) {
+  DCHECK(message != NULL);
+  COMPILE_ASSERT(offsetof(QueuedMessage, entry) == 0,
+                 queued_message_entry_must_be_first);
+
+  // Only wake up the writer when the queue goes from empty to non-empty, the
+  // writer drains the whole queue anyway.
+  PSLIST_ENTRY previous_head =
+      ::InterlockedPushEntrySList(&pending_messages_, &message->entry);
+  if (pending_wait_ == NULL) {
+    Flush();
+    return;
+  }
+  if (previous_head == NULL)
+    ::SetEvent(pending_event_);
+}
+
+void AsanLogger::StopBackgroundWriter() {
+  if (pending_wait_ != NULL) {
+    // This might get called under the loader lock, so don't block on the
+    // callbacks here. Flush serializes with a callback in flight.
+    ::UnregisterWait(pending_wait_);
+    pending_wait_ = NULL;
+  }
+  if (pending_event_ != NULL) {
+    ::CloseHandle(pending_event_);
+    pending_event_ = NULL;
+  }
+}
+
+VOID CALLBACK AsanLogger::OnMessagesPending(PVOID param, BOOLEAN timed_out) {
+  DCHECK(param != NULL);
+  AsanLogger* logger = reinterpret_cast<AsanLogger*>(param);
+  logger->Flush();
+}
+
 }  // namespace asan
 }  // namespace agent
@@ -15,9 +15,11 @@
 #ifndef SYZYGY_AGENT_ASAN_ASAN_LOGGER_H_
 #define SYZYGY_AGENT_ASAN_ASAN_LOGGER_H_
 
+#include <windows.h>  // NOLINT
 #include <string>
 
 #include "base/logging.h"
+#include "base/synchronization/lock.h"
 #include "syzygy/trace/rpc/rpc_helpers.h"
 
 namespace agent {
@@ -26,9 +28,20 @@ namespace asan {
 struct AsanErrorInfo;
 
 // A wrapper class to manage the singleton ASAN RPC logger instance.
+//
+// The calls to Write and WriteWithStackTrace don't block on the logger: the
+// messages are pushed on a lock-free queue and get sent from a thread-pool
+// callback, consecutive text messages being batched into a single RPC call.
+// The queue is flushed synchronously by WriteWithContext, SaveMiniDump, Stop
+// and Flush, so that nothing gets lost before a crash or a minidump.
+//
+// Init() is cheap: the connection to the logger, the announcement of this
+// process and the background writer are only set up when the first message
+// gets written, so a process that never reports anything never pays for them.
 class AsanLogger {
  public:
   AsanLogger();
+  ~AsanLogger();
 
   // Set the RPC instance ID to use. If an instance-id is to be used by the
   // logger, it must be set before calling Init().
@@ -46,7 +59,8 @@ class AsanLogger {
   bool minidump_on_failure() const { return minidump_on_failure_; }
   void set_minidump_on_failure(bool value) { minidump_on_failure_ = value; }
 
-  // Initialize the logger.
+  // Initialize the logger. This doesn't connect to the logger yet, this is
+  // deferred to the first message.
   void Init();
 
   // Stop the logger.
@@ -70,10 +84,47 @@ class AsanLogger {
   // @p context and @p error_info.
   void SaveMiniDump(CONTEXT* context, AsanErrorInfo* error_info);
 
+  // Synchronously send all the queued messages to the logger.
+  void Flush();
+
  protected:
-  // The RPC binding.
+  // A message waiting to be sent to the logger.
+  struct QueuedMessage;
+
+  // Connect to the logger, announce this process and start the background
+  // writer if this hasn't been attempted yet. This is a no-op before Init().
+  // @returns true if the logger is connected, false otherwise.
+  bool EnsureConnected();
+
+  // Push @p message on the queue of pending messages and wake up the
+  // background writer. The message is sent right away if there's no
+  // background writer.
+  // @param message The message to enqueue. This takes ownership of it.
+  void EnqueueMessage(QueuedMessage* message);
+
+  // Unregister the background writer, if any. This doesn't wait for an
+  // in-flight callback to return but any message it's sending will have been
+  // sent by the time the next call to Flush returns.
+  void StopBackgroundWriter();
+
+  // The callback invoked by the thread pool when messages are pending.
+  // @param param The AsanLogger instance.
+  // @param timed_out Unused.
+  static VOID CALLBACK OnMessagesPending(PVOID param, BOOLEAN timed_out);
+
+  // The RPC binding. This stays unbound until the first message is written.
   trace::client::ScopedRpcBinding rpc_binding_;
 
+  // True once Init() has been called.
+  bool initialized_;
+
+  // True once a connection to the logger has been attempted, whether it
+  // succeeded or not. Only set under connect_lock_.
+  volatile bool connect_attempted_;
+
+  // Serializes the lazy connection to the logger.
+  base::Lock connect_lock_;
+
   // The logger's instance id.
   std::wstring instance_id_;
 
@@ -85,6 +136,19 @@ class AsanLogger {
   // Default: false.
   bool minidump_on_failure_;
 
+  // The queue of the messages waiting to be sent, in LIFO order.
+  SLIST_HEADER pending_messages_;
+
+  // The auto-reset event signaled when the queue becomes non-empty, and the
+  // thread-pool wait registered on it. The wait handle is NULL if the
+  // messages are sent synchronously.
+  HANDLE pending_event_;
+  HANDLE pending_wait_;
+
+  // Serializes the draining of the queue, so that the messages reach the
+  // logger in order.
+  base::Lock flush_lock_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(AsanLogger);
 };
@@ -42,7 +42,10 @@ using testing::Return;
 
 class TestAsanLogger : public AsanLogger {
  public:
+  using AsanLogger::connect_attempted_;
   using AsanLogger::instance_id_;
+  using AsanLogger::pending_messages_;
+  using AsanLogger::pending_wait_;
   using AsanLogger::rpc_binding_;
 };
 
@@ -88,8 +91,9 @@ TEST_F(AsanLoggerTest, EndToEnd) {
     client_.set_minidump_on_failure(true);
     client_.Init();
     ASSERT_EQ(instance_id_, client_.instance_id_);
-    ASSERT_TRUE(client_.rpc_binding_.Get() != NULL);
+    ASSERT_TRUE(client_.rpc_binding_.Get() == NULL);
     client_.Write(kMessage);
+    ASSERT_TRUE(client_.rpc_binding_.Get() != NULL);
 
     // Generate a minidump.
     CONTEXT ctx = {};
@@ -117,6 +121,60 @@ TEST_F(AsanLoggerTest, EndToEnd) {
   // TODO(rogerm): Inspect the contents of the minidump.
 }
 
+TEST_F(AsanLoggerTest, FlushKeepsMessagesInOrder) {
+  const size_t kNumMessages = 100;
+
+  {
+    // Setup a log file destination.
+    file_util::ScopedFILE destination(file_util::OpenFile(temp_path_, "wb"));
+
+    // Start up the logging service.
+    trace::agent_logger::AgentLogger server;
+    trace::agent_logger::RpcLoggerInstanceManager instance_manager(&server);
+    server.set_instance_id(instance_id_);
+    server.set_destination(destination.get());
+    ASSERT_TRUE(server.Start());
+
+    client_.set_instance_id(instance_id_);
+    client_.Init();
+
+    // Interleave some text messages, some of them without a trailing newline,
+    // with some messages carrying a stack trace.
+    void* trace[] = { reinterpret_cast<void*>(&::GetCurrentThreadId) };
+    for (size_t i = 0; i < kNumMessages; ++i) {
+      std::string message(base::StringPrintf("Message %d", i));
+      if (i % 2 == 0)
+        message.push_back('\n');
+      if (i % 10 == 0)
+        client_.WriteWithStackTrace(message, trace, arraysize(trace));
+      else
+        client_.Write(message);
+    }
+    ASSERT_TRUE(client_.rpc_binding_.Get() != NULL);
+    ASSERT_TRUE(client_.pending_wait_ != NULL);
+    client_.Flush();
+
+    // The queue should have been entirely drained.
+    EXPECT_TRUE(::InterlockedFlushSList(&client_.pending_messages_) == NULL);
+
+    ASSERT_TRUE(server.Stop());
+    ASSERT_TRUE(server.Join());
+  }
+
+  // The text messages should all be there, in order and on their own line.
+  std::string content;
+  ASSERT_TRUE(file_util::ReadFileToString(temp_path_, &content));
+  size_t position = 0;
+  for (size_t i = 0; i < kNumMessages; ++i) {
+    if (i % 10 == 0)
+      continue;
+    std::string line(base::StringPrintf("Message %d\n", i));
+    size_t found = content.find(line, position);
+    ASSERT_NE(std::string::npos, found);
+    position = found + line.size();
+  }
+}
+
 TEST_F(AsanLoggerTest, Stop) {
   // Setup a log file destination.
   file_util::ScopedFILE destination(file_util::OpenFile(temp_path_, "wb"));
@@ -135,6 +193,7 @@ TEST_F(AsanLoggerTest, Stop) {
   client_.set_instance_id(instance_id_);
   client_.Init();
   ASSERT_EQ(instance_id_, client_.instance_id_);
+  client_.Write("Connect to the logger.\n");
   ASSERT_TRUE(client_.rpc_binding_.Get() != NULL);
 
   trace::common::Service* server_base = static_cast<trace::common::Service*>(
@@ -145,5 +204,24 @@ TEST_F(AsanLoggerTest, Stop) {
   ASSERT_TRUE(server.Join());
 }
 
+TEST_F(AsanLoggerTest, InitDoesNotConnect) {
+  // There's no logging service, the logger should only try to reach it on
+  // the first message.
+  client_.set_instance_id(instance_id_);
+  client_.Init();
+  EXPECT_TRUE(client_.rpc_binding_.Get() == NULL);
+  EXPECT_FALSE(client_.connect_attempted_);
+
+  // Stopping a logger that was never used doesn't connect either.
+  client_.Stop();
+  EXPECT_FALSE(client_.connect_attempted_);
+
+  // The first message attempts the connection, which fails.
+  client_.Write("Nobody is listening.\n");
+  EXPECT_TRUE(client_.connect_attempted_);
+  EXPECT_TRUE(client_.rpc_binding_.Get() == NULL);
+  EXPECT_TRUE(client_.pending_wait_ == NULL);
+}
+
 }  // namespace asan
 }  // namespace agent
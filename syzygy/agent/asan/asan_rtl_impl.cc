@@ -97,6 +97,12 @@ void ReportBadMemoryAccess(void* location,
   bad_access_info.context.Edi = asan_context->original_edi;
   bad_access_info.context.EFlags = asan_context->original_eflags;
 
+  // Check if the errors are disabled for the module doing this access.
+  if (asan_runtime->ShouldIgnoreErrorAt(
+          reinterpret_cast<const void*>(asan_context->original_eip))) {
+    return;
+  }
+
   StackCapture stack;
   stack.InitFromStack();
   // We need to compute a relative stack id so that for the same stack trace
@@ -117,6 +123,7 @@ void ReportBadMemoryAccess(void* location,
   bad_access_info.error_type = HeapProxy::UNKNOWN_BAD_ACCESS;
   bad_access_info.free_stack_size = 0U;
   bad_access_info.free_tid = 0U;
+  bad_access_info.free_stack_id = 0U;
   bad_access_info.microseconds_since_free = 0U;
 
   // Make sure this structure is not optimized out.
@@ -235,14 +242,17 @@ void CheckStringsMemoryAccesses(
 //         2GB limit) and we should report this as an invalid wild access.
 //     - Checks for zero shadow for this memory location. We use the cmp
 //         instruction so it'll set the sign flag if the upper bit of the shadow
-//         value of this memory location is set to 1.
+//         value of this memory location is set to 1. The shadow memory pages
+//         that are read before being committed fault, and get committed by
+//         the shadow memory's exception handler.
 //     - If the shadow byte is not equal to zero then it jumps to the slow path.
 //     - Otherwise it removes the memory location from the top of the stack.
 #define ASAN_FAST_PATH  \
     __asm push edx  \
     __asm sar edx, 3  \
     __asm js report_failure  \
-    __asm movzx edx, BYTE PTR[edx + agent::asan::Shadow::shadow_]  \
+    __asm add edx, DWORD PTR[agent::asan::Shadow::shadow_]  \
+    __asm movzx edx, BYTE PTR[edx]  \
     __asm cmp dl, 0  \
     __asm jnz check_access_slow  \
     __asm add esp, 4
@@ -362,6 +372,82 @@ void CheckStringsMemoryAccesses(
     }  \
   }
 
+// This moves the memory location in EDX under the return address, where the
+// error path expects to find the value of EDX saved by the caller. It's used
+// by the hooks that don't preserve EDX, as their caller doesn't save it. The
+// stack slot is released by the error path on return.
+#define ASAN_NO_EDX_ERROR_PROLOGUE  \
+    __asm push edx  \
+    __asm xchg edx, DWORD PTR[esp + 4]  \
+    __asm xchg edx, DWORD PTR[esp]
+
+// Generates a variant of the asan check access functions that doesn't preserve
+// EDX, which must be dead at the point of the access. The caller loads the
+// memory location in EDX without saving it first, and the fast path has no
+// value to restore. The name of the generated method will be
+// asan_check_(@p access_size)_byte_(@p access_mode_str)_no_edx().
+// @param access_size The size of the access (in byte).
+// @param access_mode_str The string representing the access mode (read_access
+//     or write_access).
+// @param access_mode_value The internal value representing this kind of access.
+// @note Calling this function may alter the EDX register only.
+#define ASAN_CHECK_FUNCTION_NO_EDX(access_size,  \
+                                   access_mode_str,  \
+                                   access_mode_value)  \
+  extern "C" __declspec(naked)  \
+      void asan_check_ ## access_size ## _byte_ ## access_mode_str ##  \
+          _no_edx() {  \
+    __asm {  \
+      /* Save the EFLAGS. */  \
+      ASAN_SAVE_EFLAGS  \
+      ASAN_FAST_PATH  \
+      /* Restore the EFLAGS. */  \
+      ASAN_RESTORE_EFLAGS  \
+      __asm ret  \
+    __asm check_access_slow:  \
+      ASAN_SLOW_PATH  \
+      /* Restore the EFLAGS. */  \
+      ASAN_RESTORE_EFLAGS  \
+      __asm ret  \
+    __asm report_failure:  \
+      /* Restore memory location in EDX. */  \
+      __asm pop edx  \
+      /* Restore the EFLAGS. */  \
+      ASAN_RESTORE_EFLAGS  \
+      ASAN_NO_EDX_ERROR_PROLOGUE  \
+      ASAN_ERROR_PATH(access_size, access_mode_value)  \
+    }  \
+  }
+
+// Generates a variant of the asan check access functions that preserves
+// neither EDX nor the flags. This is the cheapest check, with a fast path
+// of 8 instructions. The name of the generated method will be
+// asan_check_(@p access_size)_byte_(@p access_mode_str)_no_edx_no_flags().
+// @param access_size The size of the access (in byte).
+// @param access_mode_str The string representing the access mode (read_access
+//     or write_access).
+// @param access_mode_value The internal value representing this kind of access.
+// @note Calling this function may alter the EDX and EFLAGS registers only.
+#define ASAN_CHECK_FUNCTION_NO_EDX_NO_FLAGS(access_size,  \
+                                            access_mode_str,  \
+                                            access_mode_value)  \
+  extern "C" __declspec(naked)  \
+      void asan_check_ ## access_size ## _byte_ ## access_mode_str ##  \
+          _no_edx_no_flags() {  \
+    __asm {  \
+      ASAN_FAST_PATH  \
+      __asm ret  \
+    __asm check_access_slow:  \
+      ASAN_SLOW_PATH  \
+      __asm ret  \
+    __asm report_failure:  \
+      /* Restore memory location in EDX. */  \
+      __asm pop edx  \
+      ASAN_NO_EDX_ERROR_PROLOGUE  \
+      ASAN_ERROR_PATH(access_size, access_mode_value)  \
+    }  \
+  }
+
 // Redefine some enums to make them accessible in the inlined assembly.
 // @{
 enum AccessMode {
@@ -410,6 +496,41 @@ ASAN_CHECK_FUNCTION_NO_FLAGS(16, write_access, AsanWriteAccess)
 ASAN_CHECK_FUNCTION_NO_FLAGS(32, write_access, AsanWriteAccess)
 
 #undef ASAN_CHECK_FUNCTION_NO_FLAGS
+
+ASAN_CHECK_FUNCTION_NO_EDX(1, read_access, AsanReadAccess)
+ASAN_CHECK_FUNCTION_NO_EDX(2, read_access, AsanReadAccess)
+ASAN_CHECK_FUNCTION_NO_EDX(4, read_access, AsanReadAccess)
+ASAN_CHECK_FUNCTION_NO_EDX(8, read_access, AsanReadAccess)
+ASAN_CHECK_FUNCTION_NO_EDX(10, read_access, AsanReadAccess)
+ASAN_CHECK_FUNCTION_NO_EDX(16, read_access, AsanReadAccess)
+ASAN_CHECK_FUNCTION_NO_EDX(32, read_access, AsanReadAccess)
+ASAN_CHECK_FUNCTION_NO_EDX(1, write_access, AsanWriteAccess)
+ASAN_CHECK_FUNCTION_NO_EDX(2, write_access, AsanWriteAccess)
+ASAN_CHECK_FUNCTION_NO_EDX(4, write_access, AsanWriteAccess)
+ASAN_CHECK_FUNCTION_NO_EDX(8, write_access, AsanWriteAccess)
+ASAN_CHECK_FUNCTION_NO_EDX(10, write_access, AsanWriteAccess)
+ASAN_CHECK_FUNCTION_NO_EDX(16, write_access, AsanWriteAccess)
+ASAN_CHECK_FUNCTION_NO_EDX(32, write_access, AsanWriteAccess)
+
+#undef ASAN_CHECK_FUNCTION_NO_EDX
+
+ASAN_CHECK_FUNCTION_NO_EDX_NO_FLAGS(1, read_access, AsanReadAccess)
+ASAN_CHECK_FUNCTION_NO_EDX_NO_FLAGS(2, read_access, AsanReadAccess)
+ASAN_CHECK_FUNCTION_NO_EDX_NO_FLAGS(4, read_access, AsanReadAccess)
+ASAN_CHECK_FUNCTION_NO_EDX_NO_FLAGS(8, read_access, AsanReadAccess)
+ASAN_CHECK_FUNCTION_NO_EDX_NO_FLAGS(10, read_access, AsanReadAccess)
+ASAN_CHECK_FUNCTION_NO_EDX_NO_FLAGS(16, read_access, AsanReadAccess)
+ASAN_CHECK_FUNCTION_NO_EDX_NO_FLAGS(32, read_access, AsanReadAccess)
+ASAN_CHECK_FUNCTION_NO_EDX_NO_FLAGS(1, write_access, AsanWriteAccess)
+ASAN_CHECK_FUNCTION_NO_EDX_NO_FLAGS(2, write_access, AsanWriteAccess)
+ASAN_CHECK_FUNCTION_NO_EDX_NO_FLAGS(4, write_access, AsanWriteAccess)
+ASAN_CHECK_FUNCTION_NO_EDX_NO_FLAGS(8, write_access, AsanWriteAccess)
+ASAN_CHECK_FUNCTION_NO_EDX_NO_FLAGS(10, write_access, AsanWriteAccess)
+ASAN_CHECK_FUNCTION_NO_EDX_NO_FLAGS(16, write_access, AsanWriteAccess)
+ASAN_CHECK_FUNCTION_NO_EDX_NO_FLAGS(32, write_access, AsanWriteAccess)
+
+#undef ASAN_CHECK_FUNCTION_NO_EDX_NO_FLAGS
+#undef ASAN_NO_EDX_ERROR_PROLOGUE
 #undef ASAN_SAVE_EFLAGS
 #undef ASAN_RESTORE_EFLAGS
 #undef ASAN_FAST_PATH
@@ -539,21 +660,10 @@ void ReportBadAccess(const uint8* location, HeapProxy::AccessMode access_mode) {
 void TestMemoryRange(const uint8* memory,
                      size_t size,
                      HeapProxy::AccessMode access_mode) {
-  if (size == 0U)
-    return;
-  // TODO(sebmarchand): This approach is pretty limited because it only check
-  //     if the first and the last elements are accessible. Once we have the
-  //     plumbing in place we should benchmark a check that looks at each
-  //     address to be touched (via the shadow memory, 8 bytes at a time).
-  if (!agent::asan::Shadow::IsAccessible(memory) ||
-      !agent::asan::Shadow::IsAccessible(memory + size - 1)) {
-    const uint8* location = NULL;
-    if (!agent::asan::Shadow::IsAccessible(memory))
-      location = memory;
-    else
-      location = memory + size - 1;
+  const uint8* location = reinterpret_cast<const uint8*>(
+      agent::asan::Shadow::FindFirstPoisonedByte(memory, size));
+  if (location != NULL)
     ReportBadAccess(location, access_mode);
-  }
 }
 
 }  // namespace
@@ -271,6 +271,52 @@ void CheckAccessAndCompareContexts(void* ptr) {
   context_before_hook = NULL;
 }
 
+// Like CheckAccessAndCaptureContexts, for the checks that don't preserve EDX.
+// As the caller doesn't save EDX, the location is loaded before capturing the
+// context.
+void CheckAccessNoEdxAndCaptureContexts(
+    CONTEXT* before, CONTEXT* after, void* location) {
+  __asm {
+    pushad
+    pushfd
+
+    // Avoid undefined behavior by forcing values.
+    mov eax, 0x01234567
+    mov ebx, 0x70123456
+    mov ecx, 0x12345678
+    mov esi, 0xCCAACCAA
+    mov edi, 0xAACCAACC
+
+    // Ptr is the pointer to check.
+    mov edx, location
+
+    RTL_CAPTURE_CONTEXT(before, check_access_no_edx_expected_eip)
+
+    // Call through.
+    call dword ptr[check_access_fn + 0]
+ check_access_no_edx_expected_eip:
+
+    RTL_CAPTURE_CONTEXT(after, check_access_no_edx_expected_eip)
+
+    popfd
+    popad
+  }
+}
+
+void CheckAccessNoEdxAndCompareContexts(void* ptr) {
+  CONTEXT before = {};
+  CONTEXT after = {};
+
+  context_before_hook = &before;
+  CheckAccessNoEdxAndCaptureContexts(&before, &after, ptr);
+
+  // EDX is the only register the check is allowed to modify.
+  after.Edx = before.Edx;
+  ExpectEqualContexts(before, after, CONTEXT_FULL);
+
+  context_before_hook = NULL;
+}
+
 void CheckSpecialAccess(CONTEXT* before, CONTEXT* after,
                         void* dst, void* src, int len) {
   __asm {
@@ -403,6 +449,38 @@ TEST_F(AsanRtlTest, AsanCheckGoodAccess) {
   ASSERT_TRUE(HeapFreeFunction(heap_, 0, mem));
 }
 
+TEST_F(AsanRtlTest, AsanCheckNoEdxAccesses) {
+  static const char* function_names[] = {
+      "asan_check_4_byte_read_access_no_edx",
+      "asan_check_4_byte_write_access_no_edx",
+  };
+
+  uint8* mem = reinterpret_cast<uint8*>(
+      HeapAllocFunction(heap_, 0, kAllocSize));
+  ASSERT_TRUE(mem != NULL);
+
+  SetCallBackFunction(&AsanErrorCallback);
+  for (size_t function = 0; function < arraysize(function_names); ++function) {
+    check_access_fn = ::GetProcAddress(asan_rtl_, function_names[function]);
+    ASSERT_TRUE(check_access_fn != NULL);
+
+    // Valid accesses go through the fast and slow paths.
+    memory_error_detected = false;
+    for (size_t i = 0; i < kAllocSize; ++i)
+      ASSERT_NO_FATAL_FAILURE(CheckAccessNoEdxAndCompareContexts(mem + i));
+    EXPECT_FALSE(memory_error_detected);
+
+    // And invalid ones go through the error path.
+    expected_error_type = HeapProxy::HEAP_BUFFER_OVERFLOW;
+    ASSERT_NO_FATAL_FAILURE(
+        CheckAccessNoEdxAndCompareContexts(mem + kAllocSize));
+    EXPECT_TRUE(memory_error_detected);
+  }
+
+  EXPECT_TRUE(HeapFreeFunction(heap_, 0, mem));
+  EXPECT_TRUE(LogContains(HeapProxy::kHeapBufferOverFlow));
+}
+
 TEST_F(AsanRtlTest, AsanCheckHeapBufferOverflow) {
   check_access_fn =
       ::GetProcAddress(asan_rtl_, "asan_check_4_byte_read_access");
@@ -487,6 +565,29 @@ TEST_F(AsanRtlTest, AsanCheckWildAccess) {
   EXPECT_TRUE(LogContains(HeapProxy::kWildAccess));
 }
 
+TEST_F(AsanRtlTest, ShadowMemoryIsExported) {
+  // The runtime exports a pointer to the shadow memory.
+  uint8* const* shadow_pointer = reinterpret_cast<uint8* const*>(
+      ::GetProcAddress(asan_rtl_, "asan_shadow_memory"));
+  ASSERT_TRUE(shadow_pointer != NULL);
+  const uint8* shadow = *shadow_pointer;
+  ASSERT_TRUE(shadow != NULL);
+
+  uint8* mem = reinterpret_cast<uint8*>(
+      HeapAllocFunction(heap_, 0, kAllocSize));
+  ASSERT_TRUE(mem != NULL);
+
+  // The allocation is accessible, while the red zone following it isn't.
+  uintptr_t index =
+      reinterpret_cast<uintptr_t>(mem) >> Shadow::kShadowGranularityLog;
+  EXPECT_EQ(0u, shadow[index]);
+  index = reinterpret_cast<uintptr_t>(mem + kAllocSize) >>
+      Shadow::kShadowGranularityLog;
+  EXPECT_NE(0u, shadow[index]);
+
+  EXPECT_TRUE(HeapFreeFunction(heap_, 0, mem));
+}
+
 TEST_F(AsanRtlTest, AsanCheckInvalidAccess) {
   check_access_fn =
       ::GetProcAddress(asan_rtl_, "asan_check_4_byte_read_access");
@@ -17,15 +17,19 @@
 #include "base/bind.h"
 #include "base/command_line.h"
 #include "base/environment.h"
+#include "base/files/file_path.h"
 #include "base/logging.h"
 #include "base/string_number_conversions.h"
 #include "base/string_util.h"
 #include "base/stringprintf.h"
+#include "base/time.h"
 #include "base/utf_string_conversions.h"
 #include "base/strings/string_tokenizer.h"
 #include "base/strings/sys_string_conversions.h"
 #include "base/win/pe_image.h"
 #include "base/win/wrapped_window_proc.h"
+#include "sawbuck/common/com_utils.h"
+#include "syzygy/agent/asan/allocation_site_stats.h"
 #include "syzygy/agent/asan/asan_logger.h"
 #include "syzygy/agent/asan/asan_shadow.h"
 #include "syzygy/agent/asan/stack_capture_cache.h"
@@ -208,6 +212,29 @@ FlagResult UpdateSizetFromCommandLine(const CommandLine& cmd_line,
   return kFlagSet;
 }
 
+// Try to update the value of a stack depth from a command-line.
+// @param cmd_line The command line to parse.
+// @param param_name The parameter that we want to read.
+// @param value Will receive the depth, if present.
+// @returns false iff the parameter is present but not a depth between 1 and
+//     StackCapture::kMaxNumFrames.
+bool ReadStackDepthFromCommandLine(const CommandLine& cmd_line,
+                                   const std::string& param_name,
+                                   size_t* value) {
+  DCHECK(value != NULL);
+  size_t depth = *value;
+  if (UpdateSizetFromCommandLine(cmd_line, param_name, &depth) ==
+          kFlagError ||
+      depth == 0 || depth > StackCapture::kMaxNumFrames) {
+    LOG(ERROR) << "Unable to read " << param_name << " from the argument "
+               << "list.";
+    return false;
+  }
+  *value = depth;
+
+  return true;
+}
+
 // Try to update the value of an array of ignored stack ids from a command-line.
 // We expect the values to be in hexadecimal format and separated by a
 // semi-colon.
@@ -232,6 +259,26 @@ bool ReadIgnoredStackIdsFromCommandLine(const CommandLine& cmd_line,
   return true;
 }
 
+// Try to update the set of disabled modules from a command-line. We expect
+// the values to be module base names separated by a semi-colon, they're
+// stored in lower case.
+// @param cmd_line The command line to parse.
+// @param param_name The parameter that we want to read.
+// @param values Will receive the set of parsed values.
+void ReadDisabledModulesFromCommandLine(const CommandLine& cmd_line,
+                                        const std::string& param_name,
+                                        AsanRuntime::ModuleNameSet* values) {
+  DCHECK(values != NULL);
+  if (!cmd_line.HasSwitch(param_name))
+    return;
+  std::string value_str = cmd_line.GetSwitchValueASCII(param_name);
+  base::StringTokenizer string_tokenizer(value_str, ";");
+  while (string_tokenizer.GetNext()) {
+    std::wstring module_name = base::SysUTF8ToWide(string_tokenizer.token());
+    values->insert(StringToLowerASCII(module_name));
+  }
+}
+
 // A helper function to find if an intrusive list contains a given entry.
 // @param list The list in which we want to look for the entry.
 // @param item The entry we want to look for.
@@ -312,6 +359,16 @@ void ASANDbgPrintContext(const CONTEXT& context) {
   ASANDbgCmd(L".cxr %p; kv", reinterpret_cast<uint32>(&context));
 }
 
+// The number of allocation sites logged by default.
+const size_t kDefaultAllocationSiteReportCount = 10;
+
+// The period at which the memory monitor checks the memory pressure.
+const DWORD kMemoryMonitorPeriodMs = 1000;
+
+// The quarantines don't shrink below 1 / (1 << kMaxQuarantineSizeShift) of
+// their maximum size.
+const size_t kMaxQuarantineSizeShift = 4;
+
 // Experiment groups.
 const size_t kExperimentQuarantineSizes[] = {
   8 * 1024 * 1024,
@@ -359,27 +416,44 @@ bool GetSyzygyAsanCoinToss(uint64* value) {
 const char AsanRuntime::kSyzygyAsanCoinTossEnvVar[] = "SYZYGY_ASAN_COIN_TOSS";
 const char AsanRuntime::kSyzygyAsanOptionsEnvVar[] = "SYZYGY_ASAN_OPTIONS";
 
+const char AsanRuntime::kAdaptiveRedzoneRatio[] = "adaptive_redzone_ratio";
+const char AsanRuntime::kAllocStackDepth[] = "alloc_stack_depth";
+const char AsanRuntime::kAllocationSiteReportCount[] =
+    "allocation_site_report_count";
+const char AsanRuntime::kAllocationSiteSamplingInterval[] =
+    "allocation_site_sampling_interval";
 const char AsanRuntime::kBottomFramesToSkip[] = "bottom_frames_to_skip";
+const char AsanRuntime::kCompactFreeStacks[] = "compact_free_stacks";
 const char AsanRuntime::kCompressionReportingPeriod[] =
     "compression_reporting_period";
+const char AsanRuntime::kDisabledModules[] = "disabled_modules";
 const char AsanRuntime::kExitOnFailure[] = "exit_on_failure";
+const char AsanRuntime::kFreeStackDepth[] = "free_stack_depth";
 const char AsanRuntime::kIgnoredStackIds[] = "ignored_stack_ids";
+const char AsanRuntime::kLargeAllocationThreshold[] =
+    "large_allocation_threshold";
 const char AsanRuntime::kMaxNumberOfFrames[] = "max_num_frames";
+const char AsanRuntime::kMaxRedzoneSize[] = "max_redzone_size";
 const char AsanRuntime::kMiniDumpOnFailure[] = "minidump_on_failure";
 const char AsanRuntime::kNoLogAsText[] = "no_log_as_text";
 const char AsanRuntime::kQuarantineSize[] = "quarantine_size";
 const wchar_t AsanRuntime::kSyzyAsanDll[] = L"syzyasan_rtl.dll";
 const char AsanRuntime::kTrailerPaddingSize[] = "trailer_padding_size";
+const char AsanRuntime::kTrimQuarantineOnLowMemory[] =
+    "trim_quarantine_on_low_memory";
 
 AsanRuntime::AsanRuntime()
     : logger_(NULL), stack_cache_(NULL), asan_error_callback_(), flags_(),
-      heap_proxy_dlist_lock_(), heap_proxy_dlist_() {
+      heap_proxy_dlist_lock_(), heap_proxy_dlist_(),
+      quarantine_size_shift_(0) {
 }
 
 AsanRuntime::~AsanRuntime() {
 }
 
 void AsanRuntime::SetUp(const std::wstring& flags_command_line) {
+  base::TimeTicks start_time = base::TimeTicks::HighResNow();
+
   // Ensure that the current process is not large address aware. It shouldn't be
   // because the shadow memory assume that the process will only be able to use
   // 2GB of address space.
@@ -407,6 +481,8 @@ void AsanRuntime::SetUp(const std::wstring& flags_command_line) {
 
   // Propagates the flags values to the different modules.
   PropagateFlagsValues();
+  SetUpAllocationSiteStats();
+  SetUpMemoryMonitor();
 
   // Register the error reporting callback to use if/when an ASAN error is
   // detected. If we're able to resolve a breakpad error reporting function
@@ -432,9 +508,16 @@ void AsanRuntime::SetUp(const std::wstring& flags_command_line) {
         "asan-experiment-trailer-padding-size",
         base::UintToString(flags_.trailer_padding_size).c_str());
   }
+
+  // This doesn't go to the logger, which would force it to connect.
+  base::TimeDelta setup_time = base::TimeTicks::HighResNow() - start_time;
+  LOG(INFO) << "SyzyASAN: Runtime set up in "
+            << setup_time.InMicroseconds() << " us.";
 }
 
 void AsanRuntime::TearDown() {
+  TearDownMemoryMonitor();
+  TearDownAllocationSiteStats();
   TearDownStackCache();
   TearDownLogger();
   DCHECK(asan_error_callback_.is_null() == FALSE);
@@ -474,6 +557,10 @@ void AsanRuntime::OnError(AsanErrorInfo* error_info) {
       logger_->WriteWithStackTrace("freed here:\n",
                                    error_info->free_stack,
                                    error_info->free_stack_size);
+    } else if (error_info->free_stack_id != 0U) {
+      logger_->Write(base::StringPrintf(
+          "freed by stack_id=0x%08X (frames not kept)\n",
+          error_info->free_stack_id));
     }
     if (error_info->alloc_stack_size != NULL) {
       logger_->WriteWithStackTrace("previously allocated here:\n",
@@ -485,6 +572,10 @@ void AsanRuntime::OnError(AsanErrorInfo* error_info) {
       Shadow::AppendShadowMemoryText(error_info->location, &shadow_text);
       logger_->Write(shadow_text);
     }
+
+    // The error callback usually crashes the process, make sure the report
+    // has been sent by then.
+    logger_->Flush();
   }
 
   // Print the base of the Windbg help message.
@@ -559,17 +650,137 @@ void AsanRuntime::TearDownStackCache() {
   stack_cache_.reset();
 }
 
-bool AsanRuntime::ParseFlagsFromString(std::wstring str) {
+void AsanRuntime::SetUpAllocationSiteStats() {
+  DCHECK(allocation_site_stats_.get() == NULL);
+  if (flags_.allocation_site_sampling_interval == 0)
+    return;
+
+  allocation_site_stats_.reset(
+      new AllocationSiteStats(flags_.allocation_site_sampling_interval));
+  HeapProxy::set_allocation_site_stats(allocation_site_stats_.get());
+}
+
+void AsanRuntime::TearDownAllocationSiteStats() {
+  if (allocation_site_stats_.get() == NULL)
+    return;
+
+  DCHECK(logger_.get() != NULL);
+  allocation_site_stats_->LogTopSites(flags_.allocation_site_report_count,
+                                      logger_.get());
+
+  // The heaps that are still alive stop accounting for their blocks here.
+  HeapProxy::set_allocation_site_stats(NULL);
+  allocation_site_stats_.reset();
+}
+
+void AsanRuntime::SetUpMemoryMonitor() {
+  DCHECK(!memory_monitor_thread_.IsValid());
+  if (!flags_.trim_quarantine_on_low_memory)
+    return;
+
+  quarantine_size_shift_ = 0;
+  low_memory_notification_.Set(
+      ::CreateMemoryResourceNotification(LowMemoryResourceNotification));
+  if (!low_memory_notification_.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to create the low memory notification: "
+               << com::LogWe(error) << ".";
+    return;
+  }
+
+  memory_monitor_stop_event_.Set(::CreateEvent(NULL, TRUE, FALSE, NULL));
+  if (!memory_monitor_stop_event_.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to create an event: " << com::LogWe(error) << ".";
+    low_memory_notification_.Close();
+    return;
+  }
+
+  memory_monitor_thread_.Set(::CreateThread(NULL, 0, &MemoryMonitorThreadProc,
+                                            this, 0, NULL));
+  if (!memory_monitor_thread_.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to create the memory monitor thread: "
+               << com::LogWe(error) << ".";
+    memory_monitor_stop_event_.Close();
+    low_memory_notification_.Close();
+  }
+}
+
+void AsanRuntime::TearDownMemoryMonitor() {
+  if (!memory_monitor_thread_.IsValid())
+    return;
+
+  ::SetEvent(memory_monitor_stop_event_.Get());
+  ::WaitForSingleObject(memory_monitor_thread_.Get(), INFINITE);
+  memory_monitor_thread_.Close();
+  memory_monitor_stop_event_.Close();
+  low_memory_notification_.Close();
+}
+
+DWORD WINAPI AsanRuntime::MemoryMonitorThreadProc(void* param) {
+  AsanRuntime* runtime = reinterpret_cast<AsanRuntime*>(param);
+  DCHECK(runtime != NULL);
+
+  // The low memory notification stays signaled for as long as the memory is
+  // low, so it's polled rather than waited on.
+  while (::WaitForSingleObject(runtime->memory_monitor_stop_event_.Get(),
+                               kMemoryMonitorPeriodMs) == WAIT_TIMEOUT) {
+    BOOL low_memory = FALSE;
+    if (!::QueryMemoryResourceNotification(
+            runtime->low_memory_notification_.Get(), &low_memory)) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Unable to query the low memory notification: "
+                 << com::LogWe(error) << ".";
+      break;
+    }
+    runtime->OnMemoryPressure(low_memory != FALSE);
+  }
+
+  return 0;
+}
+
+void AsanRuntime::OnMemoryPressure(bool low_memory) {
+  size_t shift = quarantine_size_shift_;
+  if (low_memory && shift < kMaxQuarantineSizeShift) {
+    ++shift;
+  } else if (!low_memory && shift > 0) {
+    --shift;
+  } else {
+    return;
+  }
+  quarantine_size_shift_ = shift;
+
+  // The heaps created from now on get the new size too.
+  size_t quarantine_size = flags_.quarantine_size >> shift;
+  HeapProxy::set_default_quarantine_max_size(quarantine_size);
+  {
+    base::AutoLock lock(heap_proxy_dlist_lock_);
+    LIST_ENTRY* item = heap_proxy_dlist_.Flink;
+    for (; item != &heap_proxy_dlist_; item = item->Flink)
+      HeapProxy::FromListEntry(item)->SetQuarantineMaxSize(quarantine_size);
+  }
+
+  DCHECK(logger_.get() != NULL);
+  logger_->Write(base::StringPrintf(
+      "SyzyASAN: %s the quarantines to %d bytes (%s memory).\n",
+      low_memory ? "Shrinking" : "Growing",
+      quarantine_size,
+      low_memory ? "low" : "normal"));
+}
+
+bool AsanRuntime::ParseFlagsFromString(const std::wstring& str) {
   // Prepends the flags with the agent name. We need to do this because the
   // command-line constructor expect the process name to be the first value of
-  // the command-line string.
-  // Start by inserting a space at the beginning of the flags to separate the
-  // flags from the agent name.
-  str.insert(0, L" ");
-  // Insert the agent name.
-  str.insert(0, kSyzyAsanDll);
+  // the command-line string. The string is built in a single allocation, this
+  // runs on the startup path of every instrumented process.
+  std::wstring cmd_line_str;
+  cmd_line_str.reserve(arraysize(kSyzyAsanDll) + str.size());
+  cmd_line_str.append(kSyzyAsanDll);
+  cmd_line_str.push_back(L' ');
+  cmd_line_str.append(str);
 
-  CommandLine cmd_line = CommandLine::FromString(str);
+  CommandLine cmd_line = CommandLine::FromString(cmd_line_str);
 
   // Get our experiment status.
   flags_.opted_in = GetSyzygyAsanCoinToss(&flags_.coin_toss);
@@ -607,6 +818,53 @@ bool AsanRuntime::ParseFlagsFromString(std::wstring str) {
               << flags_.trailer_padding_size << ".";
   }
 
+  // Parse the large allocation threshold flag.
+  flags_.large_allocation_threshold = HeapProxy::large_allocation_threshold();
+  if (UpdateSizetFromCommandLine(cmd_line, kLargeAllocationThreshold,
+                                 &flags_.large_allocation_threshold) ==
+          kFlagError) {
+    LOG(ERROR) << "Unable to read " << kLargeAllocationThreshold << " from "
+               << "the argument list.";
+    return false;
+  }
+
+  // Parse the adaptive redzone flags.
+  flags_.adaptive_redzone_ratio = HeapProxy::adaptive_redzone_ratio();
+  if (UpdateSizetFromCommandLine(cmd_line, kAdaptiveRedzoneRatio,
+                                 &flags_.adaptive_redzone_ratio) ==
+          kFlagError) {
+    LOG(ERROR) << "Unable to read " << kAdaptiveRedzoneRatio << " from the "
+               << "argument list.";
+    return false;
+  }
+  flags_.max_redzone_size = HeapProxy::max_redzone_size();
+  if (UpdateSizetFromCommandLine(cmd_line, kMaxRedzoneSize,
+                                 &flags_.max_redzone_size) == kFlagError ||
+      flags_.max_redzone_size > HeapProxy::kMaxRedzoneSizeLimit) {
+    LOG(ERROR) << "Unable to read " << kMaxRedzoneSize << " from the "
+               << "argument list, or it's larger than "
+               << HeapProxy::kMaxRedzoneSizeLimit << ".";
+    return false;
+  }
+
+  // Parse the allocation site statistics flags.
+  flags_.allocation_site_sampling_interval = 0;
+  if (UpdateSizetFromCommandLine(cmd_line, kAllocationSiteSamplingInterval,
+                                 &flags_.allocation_site_sampling_interval) ==
+          kFlagError) {
+    LOG(ERROR) << "Unable to read " << kAllocationSiteSamplingInterval
+               << " from the argument list.";
+    return false;
+  }
+  flags_.allocation_site_report_count = kDefaultAllocationSiteReportCount;
+  if (UpdateSizetFromCommandLine(cmd_line, kAllocationSiteReportCount,
+                                 &flags_.allocation_site_report_count) ==
+          kFlagError) {
+    LOG(ERROR) << "Unable to read " << kAllocationSiteReportCount
+               << " from the argument list.";
+    return false;
+  }
+
   // Parse the reporting period flag.
   flags_.reporting_period =
       StackCaptureCache::GetDefaultCompressionReportingPeriod();
@@ -635,6 +893,18 @@ bool AsanRuntime::ParseFlagsFromString(std::wstring str) {
     return false;
   }
 
+  // Parse the alloc and free stack depth flags.
+  flags_.alloc_stack_depth = HeapProxy::alloc_stack_depth();
+  if (!ReadStackDepthFromCommandLine(cmd_line, kAllocStackDepth,
+                                     &flags_.alloc_stack_depth)) {
+    return false;
+  }
+  flags_.free_stack_depth = HeapProxy::free_stack_depth();
+  if (!ReadStackDepthFromCommandLine(cmd_line, kFreeStackDepth,
+                                     &flags_.free_stack_depth)) {
+    return false;
+  }
+
   // Parse the ignored stack ids.
   if (!ReadIgnoredStackIdsFromCommandLine(cmd_line, kIgnoredStackIds,
                                           &flags_.ignored_stack_ids)) {
@@ -643,10 +913,17 @@ bool AsanRuntime::ParseFlagsFromString(std::wstring str) {
     return false;
   }
 
+  // Parse the disabled modules.
+  ReadDisabledModulesFromCommandLine(cmd_line, kDisabledModules,
+                                     &flags_.disabled_modules);
+
   // Parse the other (boolean) flags.
   flags_.exit_on_failure = cmd_line.HasSwitch(kExitOnFailure);
   flags_.minidump_on_failure = cmd_line.HasSwitch(kMiniDumpOnFailure);
   flags_.log_as_text = !cmd_line.HasSwitch(kNoLogAsText);
+  flags_.compact_free_stacks = cmd_line.HasSwitch(kCompactFreeStacks);
+  flags_.trim_quarantine_on_low_memory =
+      cmd_line.HasSwitch(kTrimQuarantineOnLowMemory);
 
   return true;
 }
@@ -674,6 +951,13 @@ void AsanRuntime::PropagateFlagsValues() const {
   //     different modules.
   HeapProxy::set_trailer_padding_size(flags_.trailer_padding_size);
   HeapProxy::set_default_quarantine_max_size(flags_.quarantine_size);
+  HeapProxy::set_alloc_stack_depth(flags_.alloc_stack_depth);
+  HeapProxy::set_free_stack_depth(flags_.free_stack_depth);
+  HeapProxy::set_compact_free_stacks(flags_.compact_free_stacks);
+  HeapProxy::set_large_allocation_threshold(
+      flags_.large_allocation_threshold);
+  HeapProxy::set_adaptive_redzone_ratio(flags_.adaptive_redzone_ratio);
+  HeapProxy::set_max_redzone_size(flags_.max_redzone_size);
   StackCapture::set_bottom_frames_to_skip(flags_.bottom_frames_to_skip);
   StackCaptureCache::set_compression_reporting_period(flags_.reporting_period);
   stack_cache_->set_max_num_frames(flags_.max_num_frames);
@@ -681,6 +965,31 @@ void AsanRuntime::PropagateFlagsValues() const {
   logger_->set_minidump_on_failure(flags_.minidump_on_failure);
 }
 
+bool AsanRuntime::ShouldIgnoreErrorAt(const void* pc) const {
+  if (flags_.disabled_modules.empty())
+    return false;
+
+  HMODULE module = NULL;
+  if (!::GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+                               GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+                           reinterpret_cast<LPCWSTR>(pc),
+                           &module)) {
+    // The code isn't in a module, e.g. it has been generated at runtime.
+    return false;
+  }
+
+  wchar_t module_path[MAX_PATH] = {};
+  DWORD length = ::GetModuleFileName(module, module_path,
+                                     arraysize(module_path));
+  if (length == 0 || length == arraysize(module_path))
+    return false;
+
+  std::wstring module_name = StringToLowerASCII(
+      base::FilePath(module_path).BaseName().value());
+  return flags_.disabled_modules.find(module_name) !=
+      flags_.disabled_modules.end();
+}
+
 void AsanRuntime::set_flags(const AsanFlags* flags) {
   DCHECK(flags != NULL);
   flags_ = *flags;
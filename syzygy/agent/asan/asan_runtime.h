@@ -24,6 +24,7 @@
 #include "base/logging.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/synchronization/lock.h"
+#include "base/win/scoped_handle.h"
 #include "syzygy/agent/asan/asan_heap.h"
 #include "syzygy/agent/asan/stack_capture.h"
 #include "syzygy/agent/common/dlist.h"
@@ -31,6 +32,7 @@
 namespace agent {
 namespace asan {
 
+class AllocationSiteStats;
 class AsanLogger;
 
 // Store the information about a bad memory access.
@@ -69,6 +71,9 @@ struct AsanErrorInfo {
   // The time since the memory block containing this address has been freed.
   // This would be equal to zero if the block is still allocated.
   uint64 microseconds_since_free;
+  // The ID of the free stack trace, only set if the block has a compact free
+  // stack. The frames may be missing in that case.
+  StackCapture::StackId free_stack_id;
 };
 
 // An Asan Runtime manager.
@@ -92,6 +97,7 @@ struct AsanErrorInfo {
 class AsanRuntime {
  public:
   typedef std::set<StackCapture::StackId> StackIdSet;
+  typedef std::set<std::wstring> ModuleNameSet;
 
   // The type of callback used by the OnError function.
   typedef base::Callback<void(AsanErrorInfo*)> AsanOnErrorCallBack;
@@ -150,6 +156,10 @@ class AsanRuntime {
         flags_.ignored_stack_ids.end();
   }
 
+  // Returns true if we should ignore the errors reported by the code at
+  // @p pc because its module has been disabled, false otherwise.
+  bool ShouldIgnoreErrorAt(const void* pc) const;
+
   // Get information about a bad access.
   // @param bad_access_info Will receive the information about this access.
   void GetBadAccessInformation(AsanErrorInfo* error_info);
@@ -169,10 +179,19 @@ class AsanRuntime {
           reporting_period(0U),
           bottom_frames_to_skip(0U),
           max_num_frames(0U),
+          alloc_stack_depth(0U),
+          free_stack_depth(0U),
           trailer_padding_size(0U),
+          large_allocation_threshold(0U),
+          adaptive_redzone_ratio(0U),
+          max_redzone_size(0U),
+          allocation_site_sampling_interval(0U),
+          allocation_site_report_count(0U),
           exit_on_failure(false),
           minidump_on_failure(false),
           log_as_text(true),
+          compact_free_stacks(false),
+          trim_quarantine_on_low_memory(false),
           opted_in(false),
           coin_toss(0) {
     }
@@ -190,12 +209,35 @@ class AsanRuntime {
     // The max number of frames for a stack trace.
     size_t max_num_frames;
 
+    // The max number of frames captured on allocation and on free.
+    size_t alloc_stack_depth;
+    size_t free_stack_depth;
+
     // The size of the padding added to every memory block trailer.
     size_t trailer_padding_size;
 
+    // The size above which allocations get pages of their own, or zero.
+    size_t large_allocation_threshold;
+
+    // The ratio of the allocation size the redzones of a block aim for, or
+    // zero, and the size above which these adaptive redzones don't grow.
+    size_t adaptive_redzone_ratio;
+    size_t max_redzone_size;
+
+    // One allocation out of every allocation_site_sampling_interval gets
+    // accounted in the per-allocation-site statistics, which get logged on
+    // tear-down. Defaults to zero, which disables them.
+    size_t allocation_site_sampling_interval;
+
+    // The number of allocation sites to log, by decreasing overhead.
+    size_t allocation_site_report_count;
+
     // The stack ids we ignore.
     StackIdSet ignored_stack_ids;
 
+    // The lower-cased base names of the modules for which we ignore errors.
+    ModuleNameSet disabled_modules;
+
     // If true, we should generate a minidump whenever an error is detected.
     // Defaults to false.
     bool minidump_on_failure;
@@ -208,6 +250,14 @@ class AsanRuntime {
     // Defaults to true;
     bool log_as_text;
 
+    // If true, the quarantined blocks only keep the ID of their free stack.
+    // Defaults to false.
+    bool compact_free_stacks;
+
+    // If true, the quarantines shrink while the system is low on memory, and
+    // grow back once it isn't anymore. Defaults to false.
+    bool trim_quarantine_on_low_memory;
+
     // Experiment configuration.
     bool opted_in;
     uint64 coin_toss;
@@ -215,16 +265,26 @@ class AsanRuntime {
 
   // @name Flag strings.
   // @{
+  static const char kAdaptiveRedzoneRatio[];
+  static const char kAllocStackDepth[];
+  static const char kAllocationSiteReportCount[];
+  static const char kAllocationSiteSamplingInterval[];
   static const char kBottomFramesToSkip[];
+  static const char kCompactFreeStacks[];
   static const char kCompressionReportingPeriod[];
+  static const char kDisabledModules[];
   static const char kExitOnFailure[];
+  static const char kFreeStackDepth[];
   static const char kIgnoredStackIds[];
+  static const char kLargeAllocationThreshold[];
   static const char kMaxNumberOfFrames[];
+  static const char kMaxRedzoneSize[];
   static const char kMiniDumpOnFailure[];
   static const char kNoLogAsText[];
   static const char kQuarantineSize[];
   static const wchar_t kSyzyAsanDll[];
   static const char kTrailerPaddingSize[];
+  static const char kTrimQuarantineOnLowMemory[];
   // @}
 
   // @name Accessors.
@@ -240,6 +300,13 @@ class AsanRuntime {
   // Propagate the values of the flags to the target modules.
   void PropagateFlagsValues() const;
 
+  // Adapts the quarantines of all the heaps to the memory pressure. Each
+  // low memory report halves their maximum size, down to a floor, and each
+  // report of a normal memory state doubles it back, up to the size given by
+  // the flags.
+  // @param low_memory true iff the system is low on memory.
+  void OnMemoryPressure(bool low_memory);
+
  private:
   // Set up the logger.
   void SetUpLogger();
@@ -253,8 +320,23 @@ class AsanRuntime {
   // Tear down the stack cache.
   void TearDownStackCache();
 
+  // Set up the per-allocation-site statistics, if they're enabled.
+  void SetUpAllocationSiteStats();
+
+  // Log and tear down the per-allocation-site statistics.
+  void TearDownAllocationSiteStats();
+
+  // Start and stop the thread watching the memory pressure, if the
+  // quarantines are trimmed on low memory.
+  void SetUpMemoryMonitor();
+  void TearDownMemoryMonitor();
+
+  // The entry point of the memory monitor thread.
+  // @param param The runtime.
+  static DWORD WINAPI MemoryMonitorThreadProc(void* param);
+
   // Parse and set the flags from the wide string @p str.
-  bool ParseFlagsFromString(std::wstring str);
+  bool ParseFlagsFromString(const std::wstring& str);
 
   // The shared logger instance that will be used by all heap proxies.
   scoped_ptr<AsanLogger> logger_;
@@ -262,6 +344,10 @@ class AsanRuntime {
   // The shared stack cache instance that will be used by all heap proxies.
   scoped_ptr<StackCaptureCache> stack_cache_;
 
+  // The per-allocation-site statistics shared by all heap proxies, or NULL
+  // if they're disabled.
+  scoped_ptr<AllocationSiteStats> allocation_site_stats_;
+
   // The asan error callback functor.
   AsanOnErrorCallBack asan_error_callback_;
 
@@ -274,6 +360,15 @@ class AsanRuntime {
   // The heap proxies list.
   LIST_ENTRY heap_proxy_dlist_;  // Under heap_proxy_dlist_lock.
 
+  // @name The memory monitor state.
+  // @{
+  base::win::ScopedHandle low_memory_notification_;
+  base::win::ScopedHandle memory_monitor_stop_event_;
+  base::win::ScopedHandle memory_monitor_thread_;
+  // The quarantines are shrunk to quarantine_size >> quarantine_size_shift_.
+  size_t quarantine_size_shift_;
+  // @}
+
   DISALLOW_COPY_AND_ASSIGN(AsanRuntime);
 };
 
@@ -18,9 +18,12 @@
 #include "base/command_line.h"
 #include "base/environment.h"
 #include "base/string_number_conversions.h"
+#include "base/string_util.h"
 #include "base/utf_string_conversions.h"
+#include "base/files/file_path.h"
 #include "base/memory/scoped_ptr.h"
 #include "gtest/gtest.h"
+#include "syzygy/agent/asan/allocation_site_stats.h"
 #include "syzygy/agent/asan/asan_heap.h"
 #include "syzygy/agent/asan/asan_logger.h"
 #include "syzygy/agent/asan/unittest_util.h"
@@ -37,12 +40,23 @@ using agent::asan::HeapProxy;
 class TestAsanRuntime : public AsanRuntime {
  public:
   using AsanRuntime::AsanFlags;
+  using AsanRuntime::kAdaptiveRedzoneRatio;
+  using AsanRuntime::kAllocStackDepth;
+  using AsanRuntime::kAllocationSiteReportCount;
+  using AsanRuntime::kAllocationSiteSamplingInterval;
   using AsanRuntime::kBottomFramesToSkip;
+  using AsanRuntime::kCompactFreeStacks;
   using AsanRuntime::kCompressionReportingPeriod;
+  using AsanRuntime::kDisabledModules;
   using AsanRuntime::kExitOnFailure;
+  using AsanRuntime::kFreeStackDepth;
   using AsanRuntime::kIgnoredStackIds;
+  using AsanRuntime::kLargeAllocationThreshold;
+  using AsanRuntime::kMaxRedzoneSize;
   using AsanRuntime::kQuarantineSize;
   using AsanRuntime::kTrailerPaddingSize;
+  using AsanRuntime::kTrimQuarantineOnLowMemory;
+  using AsanRuntime::OnMemoryPressure;
   using AsanRuntime::PropagateFlagsValues;
   using AsanRuntime::flags;
   using AsanRuntime::set_flags;
@@ -185,6 +199,75 @@ TEST_F(AsanRuntimeTest, SetBottomFramesToSkip) {
   EXPECT_EQ(frames_to_skip, StackCapture::bottom_frames_to_skip());
 }
 
+TEST_F(AsanRuntimeTest, SetStackDepths) {
+  current_command_line_.AppendSwitchASCII(
+      TestAsanRuntime::kAllocStackDepth, "10");
+  current_command_line_.AppendSwitchASCII(
+      TestAsanRuntime::kFreeStackDepth, "5");
+
+  ASSERT_NO_FATAL_FAILURE(
+      asan_runtime_.SetUp(current_command_line_.GetCommandLineString()));
+
+  EXPECT_EQ(10U, HeapProxy::alloc_stack_depth());
+  EXPECT_EQ(5U, HeapProxy::free_stack_depth());
+}
+
+TEST_F(AsanRuntimeTest, SetLargeAllocationThreshold) {
+  current_command_line_.AppendSwitchASCII(
+      TestAsanRuntime::kLargeAllocationThreshold, "65536");
+
+  ASSERT_NO_FATAL_FAILURE(
+      asan_runtime_.SetUp(current_command_line_.GetCommandLineString()));
+
+  EXPECT_EQ(65536U, HeapProxy::large_allocation_threshold());
+}
+
+TEST_F(AsanRuntimeTest, SetAdaptiveRedzones) {
+  current_command_line_.AppendSwitchASCII(
+      TestAsanRuntime::kAdaptiveRedzoneRatio, "4");
+  current_command_line_.AppendSwitchASCII(
+      TestAsanRuntime::kMaxRedzoneSize, "512");
+
+  ASSERT_NO_FATAL_FAILURE(
+      asan_runtime_.SetUp(current_command_line_.GetCommandLineString()));
+  EXPECT_EQ(4U, asan_runtime_.flags()->adaptive_redzone_ratio);
+  EXPECT_EQ(512U, asan_runtime_.flags()->max_redzone_size);
+  EXPECT_EQ(4U, HeapProxy::adaptive_redzone_ratio());
+  EXPECT_EQ(512U, HeapProxy::max_redzone_size());
+}
+
+TEST_F(AsanRuntimeTest, SetAllocationSiteSamplingInterval) {
+  ASSERT_NO_FATAL_FAILURE(
+      asan_runtime_.SetUp(current_command_line_.GetCommandLineString()));
+  EXPECT_EQ(0U, asan_runtime_.flags()->allocation_site_sampling_interval);
+  EXPECT_TRUE(HeapProxy::allocation_site_stats() == NULL);
+  ASSERT_NO_FATAL_FAILURE(asan_runtime_.TearDown());
+
+  current_command_line_.AppendSwitchASCII(
+      TestAsanRuntime::kAllocationSiteSamplingInterval, "16");
+  current_command_line_.AppendSwitchASCII(
+      TestAsanRuntime::kAllocationSiteReportCount, "5");
+  ASSERT_NO_FATAL_FAILURE(
+      asan_runtime_.SetUp(current_command_line_.GetCommandLineString()));
+  EXPECT_EQ(16U, asan_runtime_.flags()->allocation_site_sampling_interval);
+  EXPECT_EQ(5U, asan_runtime_.flags()->allocation_site_report_count);
+  ASSERT_TRUE(HeapProxy::allocation_site_stats() != NULL);
+  EXPECT_EQ(16U, HeapProxy::allocation_site_stats()->sampling_interval());
+
+  // The statistics get logged and released on tear-down.
+  ASSERT_NO_FATAL_FAILURE(asan_runtime_.TearDown());
+  EXPECT_TRUE(HeapProxy::allocation_site_stats() == NULL);
+}
+
+TEST_F(AsanRuntimeTest, SetCompactFreeStacks) {
+  current_command_line_.AppendSwitch(TestAsanRuntime::kCompactFreeStacks);
+
+  ASSERT_NO_FATAL_FAILURE(
+      asan_runtime_.SetUp(current_command_line_.GetCommandLineString()));
+  EXPECT_TRUE(asan_runtime_.flags()->compact_free_stacks);
+  EXPECT_TRUE(HeapProxy::compact_free_stacks());
+}
+
 TEST_F(AsanRuntimeTest, SetTrailerPaddingSize) {
   size_t trailer_padding_size = HeapProxy::trailer_padding_size() + 1;
   std::string new_trailer_padding_size_str =
@@ -198,6 +281,44 @@ TEST_F(AsanRuntimeTest, SetTrailerPaddingSize) {
   EXPECT_EQ(trailer_padding_size, HeapProxy::trailer_padding_size());
 }
 
+TEST_F(AsanRuntimeTest, TrimQuarantineOnLowMemory) {
+  current_command_line_.AppendSwitch(
+      TestAsanRuntime::kTrimQuarantineOnLowMemory);
+
+  ASSERT_NO_FATAL_FAILURE(
+      asan_runtime_.SetUp(current_command_line_.GetCommandLineString()));
+  EXPECT_TRUE(asan_runtime_.flags()->trim_quarantine_on_low_memory);
+  size_t quarantine_size = asan_runtime_.flags()->quarantine_size;
+
+  HeapProxy heap_proxy;
+  ASSERT_TRUE(heap_proxy.Create(0, 0, 0));
+  asan_runtime_.AddHeap(&heap_proxy);
+  EXPECT_EQ(quarantine_size, heap_proxy.quarantine_max_size());
+
+  // The quarantines shrink for as long as the memory is low, down to a
+  // floor.
+  asan_runtime_.OnMemoryPressure(true);
+  EXPECT_EQ(quarantine_size / 2, heap_proxy.quarantine_max_size());
+  EXPECT_EQ(quarantine_size / 2, HeapProxy::default_quarantine_max_size());
+  for (size_t i = 0; i < 10; ++i)
+    asan_runtime_.OnMemoryPressure(true);
+  size_t min_quarantine_size = heap_proxy.quarantine_max_size();
+  EXPECT_LT(0U, min_quarantine_size);
+  EXPECT_GT(quarantine_size / 2, min_quarantine_size);
+
+  // They grow back once it isn't low anymore.
+  asan_runtime_.OnMemoryPressure(false);
+  EXPECT_EQ(min_quarantine_size * 2, heap_proxy.quarantine_max_size());
+  for (size_t i = 0; i < 10; ++i)
+    asan_runtime_.OnMemoryPressure(false);
+  EXPECT_EQ(quarantine_size, heap_proxy.quarantine_max_size());
+  EXPECT_EQ(quarantine_size, HeapProxy::default_quarantine_max_size());
+
+  asan_runtime_.RemoveHeap(&heap_proxy);
+  ASSERT_TRUE(heap_proxy.Destroy());
+  ASSERT_NO_FATAL_FAILURE(asan_runtime_.TearDown());
+}
+
 TEST_F(AsanRuntimeTest, SetExitOnFailure) {
   current_command_line_.AppendSwitch(TestAsanRuntime::kExitOnFailure);
 
@@ -243,6 +364,32 @@ TEST_F(AsanRuntimeTest, IgnoredStackIds) {
               asan_runtime_.flags()->ignored_stack_ids.end());
 }
 
+TEST_F(AsanRuntimeTest, DisabledModules) {
+  wchar_t exe_path[MAX_PATH] = {};
+  ASSERT_NE(0u, ::GetModuleFileName(NULL, exe_path, arraysize(exe_path)));
+  std::string exe_name = StringToUpperASCII(
+      WideToUTF8(base::FilePath(exe_path).BaseName().value()));
+
+  current_command_line_.AppendSwitchASCII(
+      TestAsanRuntime::kDisabledModules, "foo.dll;" + exe_name);
+
+  ASSERT_NO_FATAL_FAILURE(
+      asan_runtime_.SetUp(current_command_line_.GetCommandLineString()));
+
+  EXPECT_EQ(2u, asan_runtime_.flags()->disabled_modules.size());
+  EXPECT_TRUE(asan_runtime_.flags()->disabled_modules.find(L"foo.dll") !=
+              asan_runtime_.flags()->disabled_modules.end());
+
+  // The errors in this executable are ignored, those in kernel32 aren't.
+  EXPECT_TRUE(asan_runtime_.ShouldIgnoreErrorAt(
+      reinterpret_cast<const void*>(&TestCallback)));
+  HMODULE kernel32 = ::GetModuleHandle(L"kernel32.dll");
+  ASSERT_TRUE(kernel32 != NULL);
+  EXPECT_FALSE(asan_runtime_.ShouldIgnoreErrorAt(
+      reinterpret_cast<const void*>(::GetProcAddress(kernel32,
+                                                     "GetTickCount"))));
+}
+
 TEST_F(AsanRuntimeTest, SetFlags) {
   ASSERT_NO_FATAL_FAILURE(
       asan_runtime_.SetUp(current_command_line_.GetCommandLineString()));
@@ -259,6 +406,8 @@ TEST_F(AsanRuntimeTest, SetFlags) {
   flags.max_num_frames =
       asan_runtime_.stack_cache()->max_num_frames() - 1;
   ASSERT_LT(0U, flags.max_num_frames);
+  flags.alloc_stack_depth = HeapProxy::alloc_stack_depth() - 1;
+  flags.free_stack_depth = HeapProxy::free_stack_depth() - 2;
   asan_runtime_.set_flags(&flags);
   asan_runtime_.PropagateFlagsValues();
 
@@ -268,6 +417,8 @@ TEST_F(AsanRuntimeTest, SetFlags) {
   ASSERT_EQ(flags.bottom_frames_to_skip, StackCapture::bottom_frames_to_skip());
   ASSERT_EQ(flags.max_num_frames,
             asan_runtime_.stack_cache()->max_num_frames());
+  ASSERT_EQ(flags.alloc_stack_depth, HeapProxy::alloc_stack_depth());
+  ASSERT_EQ(flags.free_stack_depth, HeapProxy::free_stack_depth());
 }
 
 TEST_F(AsanRuntimeTest, NotOptedInWithNoCoinToss) {
@@ -13,30 +13,161 @@
 // limitations under the License.
 #include "syzygy/agent/asan/asan_shadow.h"
 
+#include <emmintrin.h>
+#include <algorithm>
+
 #include "base/logging.h"
 #include "base/stringprintf.h"
 
 namespace agent {
 namespace asan {
 
-uint8 Shadow::shadow_[kShadowSize];
+namespace {
+
+// The size and alignment of an SSE2 register, in bytes.
+const size_t kVectorSize = sizeof(__m128i);
+
+// Fills bigger than this bypass the cache, as they'd only evict useful data
+// from it. This typically is the case of the poisoning of large allocations.
+const size_t kNonTemporalFillThreshold = 1024 * 1024;
+
+// Returns true iff @p pointer is aligned to kVectorSize.
+bool IsVectorAligned(const void* pointer) {
+  return (reinterpret_cast<uintptr_t>(pointer) & (kVectorSize - 1)) == 0;
+}
+
+// Sets the @p count shadow bytes starting at @p shadow to @p value. The bulk
+// of the range is written with aligned 16-byte SSE2 stores.
+void FillShadow(uint8* shadow, size_t count, uint8 value) {
+  uint8* end = shadow + count;
+  while (shadow != end && !IsVectorAligned(shadow))
+    *shadow++ = value;
+
+  __m128i wide_value = _mm_set1_epi8(static_cast<char>(value));
+  __m128i* vector = reinterpret_cast<__m128i*>(shadow);
+  __m128i* vector_end = vector + (end - shadow) / kVectorSize;
+  if (count >= kNonTemporalFillThreshold) {
+    for (; vector != vector_end; ++vector)
+      _mm_stream_si128(vector, wide_value);
+    // Make the non-temporal stores visible before anything that follows.
+    _mm_sfence();
+  } else {
+    for (; vector != vector_end; ++vector)
+      _mm_store_si128(vector, wide_value);
+  }
+
+  shadow = reinterpret_cast<uint8*>(vector_end);
+  while (shadow != end)
+    *shadow++ = value;
+}
+
+// Returns true iff @p word contains a zero byte.
+bool HasZeroByte(uint64 word) {
+  return ((word - 0x0101010101010101ULL) & ~word & 0x8080808080808080ULL) != 0;
+}
+
+// Returns a pointer to the first non-zero shadow byte in [@p shadow, @p end),
+// or @p end if they're all zero. The bulk of the shadow is scanned 64 bytes,
+// i.e. 512 bytes of application memory, at a time, and what's left 8 bytes
+// at a time.
+const uint8* FindNonZeroShadowByte(const uint8* shadow, const uint8* end) {
+  while (shadow != end && !IsVectorAligned(shadow)) {
+    if (*shadow != 0)
+      return shadow;
+    ++shadow;
+  }
+
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i* vector = reinterpret_cast<const __m128i*>(shadow);
+  const __m128i* vector_end = vector + (end - shadow) / (4 * kVectorSize) * 4;
+  for (; vector != vector_end; vector += 4) {
+    __m128i any = _mm_or_si128(
+        _mm_or_si128(_mm_load_si128(vector), _mm_load_si128(vector + 1)),
+        _mm_or_si128(_mm_load_si128(vector + 2), _mm_load_si128(vector + 3)));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) != 0xFFFF)
+      break;
+  }
+
+  // Narrow down the block that failed the check, or scan the remainder of
+  // the range, 8 bytes at a time and then byte by byte.
+  const uint64* word = reinterpret_cast<const uint64*>(vector);
+  const uint64* word_end = word + (end - reinterpret_cast<const uint8*>(word)) /
+      sizeof(uint64);
+  while (word != word_end && *word == 0)
+    ++word;
+
+  for (shadow = reinterpret_cast<const uint8*>(word); shadow != end;
+       ++shadow) {
+    if (*shadow != 0)
+      return shadow;
+  }
+  return end;
+}
+
+// Returns the first inaccessible byte in [@p begin, @p end), or NULL if
+// there is none. This is meant for ranges that don't span more than one
+// 8-byte group.
+const uint8* FindFirstInaccessibleByte(const uint8* begin, const uint8* end) {
+  for (; begin != end; ++begin) {
+    if (!Shadow::IsAccessible(begin))
+      return begin;
+  }
+  return NULL;
+}
+
+}  // namespace
+
+uint8* Shadow::shadow_ = NULL;
+volatile LONG Shadow::claimed_pages_[kShadowPageCount / 32];
+volatile LONG Shadow::committed_pages_[kShadowPageCount / 32];
+bool Shadow::shadow_memory_is_poisoned_ = false;
+void* Shadow::exception_handler_ = NULL;
 
 void Shadow::SetUp() {
-  // Poison the shadow memory.
-  Poison(shadow_, kShadowSize, kAsanMemoryByte);
+  Reset();
+
+  // Poison the shadow memory. This is done lazily, as its pages get
+  // committed.
+  shadow_memory_is_poisoned_ = true;
   // Poison the first 64k of the memory as they're not addressable.
   Poison(0, 0x10000, kInvalidAddress);
+
+  // The instrumentation reads the shadow memory directly, so its reads of the
+  // pages that aren't committed yet fault, and get them committed.
+  if (exception_handler_ == NULL) {
+    exception_handler_ = ::AddVectoredExceptionHandler(TRUE, &OnException);
+    CHECK(exception_handler_ != NULL)
+        << "Unable to add the shadow memory exception handler.";
+  }
 }
 
 void Shadow::TearDown() {
-  // Unpoison the shadow memory.
-  Unpoison(shadow_, kShadowSize);
-  // Unpoison the first 64k of the memory.
-  Unpoison(0, 0x10000);
+  if (exception_handler_ != NULL) {
+    ::RemoveVectoredExceptionHandler(exception_handler_);
+    exception_handler_ = NULL;
+  }
+
+  // Release the shadow memory.
+  if (shadow_ != NULL) {
+    ::VirtualFree(shadow_, 0, MEM_RELEASE);
+    shadow_ = NULL;
+  }
+  memset(const_cast<LONG*>(claimed_pages_), 0, sizeof(claimed_pages_));
+  memset(const_cast<LONG*>(committed_pages_), 0, sizeof(committed_pages_));
+  shadow_memory_is_poisoned_ = false;
 }
 
 void Shadow::Reset() {
-  memset(shadow_, 0, kShadowSize);
+  if (shadow_ == NULL) {
+    shadow_ = reinterpret_cast<uint8*>(
+        ::VirtualAlloc(NULL, kShadowSize, MEM_RESERVE, PAGE_NOACCESS));
+    CHECK(shadow_ != NULL) << "Unable to reserve the shadow memory.";
+  } else {
+    ::VirtualFree(shadow_, kShadowSize, MEM_DECOMMIT);
+  }
+  memset(const_cast<LONG*>(claimed_pages_), 0, sizeof(claimed_pages_));
+  memset(const_cast<LONG*>(committed_pages_), 0, sizeof(committed_pages_));
+  shadow_memory_is_poisoned_ = false;
 }
 
 void Shadow::Poison(const void* addr, size_t size, ShadowMarker shadow_val) {
@@ -45,12 +176,14 @@ void Shadow::Poison(const void* addr, size_t size, ShadowMarker shadow_val) {
   DCHECK_EQ(0U, (index + size) & 0x7);
 
   index >>= 3;
+  size >>= 3;
+  uintptr_t end = index + size + (start != 0 ? 1 : 0);
+  DCHECK_GT(kShadowSize, end);
+  CommitShadow(index, end);
+
   if (start)
     shadow_[index++] = start;
-
-  size >>= 3;
-  DCHECK_GT(arraysize(shadow_), index + size);
-  memset(shadow_ + index, shadow_val, size);
+  FillShadow(shadow_ + index, size, shadow_val);
 }
 
 void Shadow::Unpoison(const void* addr, size_t size) {
@@ -60,11 +193,47 @@ void Shadow::Unpoison(const void* addr, size_t size) {
   uint8 remainder = size & 0x7;
   index >>= 3;
   size >>= 3;
-  DCHECK_GT(arraysize(shadow_), index + size);
-  memset(shadow_ + index, kHeapAddressableByte, size);
+  DCHECK_GT(kShadowSize, index + size);
+  ClearShadow(index, index + size);
 
-  if (remainder != 0)
+  if (remainder != 0) {
+    CommitShadow(index + size, index + size + 1);
     shadow_[index + size] = remainder;
+  }
+}
+
+void Shadow::UnpoisonAndDecommit(const void* addr, size_t size) {
+  uintptr_t index = reinterpret_cast<uintptr_t>(addr);
+  DCHECK_EQ(0U, index & 0x7);
+  DCHECK_EQ(0U, size & 0x7);
+
+  uintptr_t begin = index >> 3;
+  uintptr_t end = begin + (size >> 3);
+  DCHECK_GT(kShadowSize, end);
+
+  // The shadow pages partially covering the range are zeroed as usual.
+  size_t first_page = (begin + kShadowPageSize - 1) / kShadowPageSize;
+  size_t last_page = end / kShadowPageSize;
+  if (first_page >= last_page) {
+    ClearShadow(begin, end);
+    return;
+  }
+  ClearShadow(begin, first_page * kShadowPageSize);
+  ClearShadow(last_page * kShadowPageSize, end);
+
+  // The other ones are decommitted in one go, which zeroes them. Pages that
+  // aren't committed are left as they are by VirtualFree.
+  DCHECK_EQ(0U, GetDefaultShadowByte(first_page));
+  for (size_t page = first_page; page < last_page; ++page) {
+    if (IsShadowPageCommitted(page)) {
+      LONG mask = 1 << (page % 32);
+      ::InterlockedAnd(&committed_pages_[page / 32], ~mask);
+      ::InterlockedAnd(&claimed_pages_[page / 32], ~mask);
+    }
+  }
+  ::VirtualFree(shadow_ + first_page * kShadowPageSize,
+                (last_page - first_page) * kShadowPageSize,
+                MEM_DECOMMIT);
 }
 
 void Shadow::MarkAsFreed(const void* addr, size_t size) {
@@ -72,12 +241,15 @@ void Shadow::MarkAsFreed(const void* addr, size_t size) {
   uintptr_t start = index & 0x7;
 
   index >>= 3;
+  size_t size_shadow = size >> 3;
+  uintptr_t end = index + size_shadow + (start != 0 ? 1 : 0) +
+      ((size & 0x7) != 0 ? 1 : 0);
+  DCHECK_GT(kShadowSize, end);
+  CommitShadow(index, end);
+
   if (start)
     shadow_[index++] = kHeapFreedByte;
-
-  size_t size_shadow = size >> 3;
-  DCHECK_GT(arraysize(shadow_), index + size_shadow);
-  memset(shadow_ + index, kHeapFreedByte, size_shadow);
+  FillShadow(shadow_ + index, size_shadow, kHeapFreedByte);
   if ((size & 0x7) != 0)
     shadow_[index + size_shadow] = kHeapFreedByte;
 }
@@ -88,8 +260,7 @@ bool Shadow::IsAccessible(const void* addr) {
 
   index >>= 3;
 
-  DCHECK_GT(arraysize(shadow_), index);
-  uint8 shadow = shadow_[index];
+  uint8 shadow = GetShadowByte(index);
   if (shadow == 0)
     return true;
 
@@ -99,12 +270,54 @@ bool Shadow::IsAccessible(const void* addr) {
   return start < shadow;
 }
 
+bool Shadow::IsRangeAccessible(const void* addr, size_t size) {
+  return FindFirstPoisonedByte(addr, size) == NULL;
+}
+
+const void* Shadow::FindFirstPoisonedByte(const void* addr, size_t size) {
+  if (size == 0)
+    return NULL;
+
+  const uint8* begin = reinterpret_cast<const uint8*>(addr);
+  const uint8* end = begin + size;
+  DCHECK_LT(begin, end);
+
+  // Check the bytes of the range that belong to a partial 8-byte group at its
+  // beginning.
+  const uint8* aligned_begin = reinterpret_cast<const uint8*>(
+      (reinterpret_cast<uintptr_t>(begin) + kShadowGranularity - 1) &
+          ~(kShadowGranularity - 1));
+  if (aligned_begin != begin) {
+    const uint8* bad = FindFirstInaccessibleByte(begin,
+                                                 std::min(end, aligned_begin));
+    if (bad != NULL || end <= aligned_begin)
+      return bad;
+  }
+
+  // All the groups up to the end of the range must be fully addressable.
+  const uint8* aligned_end = reinterpret_cast<const uint8*>(
+      reinterpret_cast<uintptr_t>(end) & ~(kShadowGranularity - 1));
+  uintptr_t index = reinterpret_cast<uintptr_t>(aligned_begin) >> 3;
+  uintptr_t end_index = reinterpret_cast<uintptr_t>(aligned_end) >> 3;
+  DCHECK_GE(kShadowSize, end_index);
+  uintptr_t bad_index = FindNonZeroShadowIndex(index, end_index);
+  if (bad_index != end_index) {
+    const uint8* group = reinterpret_cast<const uint8*>(bad_index << 3);
+    const uint8* bad = FindFirstInaccessibleByte(group,
+                                                 group + kShadowGranularity);
+    DCHECK(bad != NULL);
+    return bad;
+  }
+
+  // The last group of the range may also be partial.
+  return FindFirstInaccessibleByte(aligned_end, end);
+}
+
 Shadow::ShadowMarker Shadow::GetShadowMarkerForAddress(const void* addr) {
   uintptr_t index = reinterpret_cast<uintptr_t>(addr);
   index >>= 3;
 
-  DCHECK_GT(arraysize(shadow_), index);
-  return static_cast<ShadowMarker>(shadow_[index]);
+  return static_cast<ShadowMarker>(GetShadowByte(index));
 }
 
 void Shadow::AppendShadowByteText(const char *prefix,
@@ -117,7 +330,7 @@ void Shadow::AppendShadowByteText(const char *prefix,
   for (uint32 i = 0; i < 8; i++) {
     if (index + i == bug_index)
       separator = '[';
-    uint8 shadow_value = shadow_[index + i];
+    uint8 shadow_value = GetShadowByte(index + i);
     base::StringAppendF(
         output, "%c%x%x", separator, shadow_value >> 4, shadow_value & 15);
     if (separator == '[')
@@ -161,25 +374,34 @@ bool Shadow::GetNullTerminatedArraySize(const void* addr,
   DCHECK(addr != NULL);
   DCHECK(size != NULL);
 
-  uintptr_t index = reinterpret_cast<uintptr_t>(addr);
   const uint8* addr_value = reinterpret_cast<const uint8*>(addr);
-  index >>= 3;
   *size = 0;
 
-  // Scan the input array 8 bytes at a time until we've found a NULL value or
-  // we've reached the end of an accessible memory block.
-  // TODO(sebmarchand): Look into doing this more efficiently.
+  // Scan the input array one 8-byte group at a time until we've found a NULL
+  // value or we've reached the end of an accessible memory block.
   while (true) {
-    uint8 shadow = shadow_[index++];
+    uintptr_t group = reinterpret_cast<uintptr_t>(addr_value) &
+        ~(kShadowGranularity - 1);
+    uint8 shadow = GetShadowByte(group >> 3);
     if ((shadow & kHeapNonAccessibleByteMask) != 0)
       return false;
 
-    uint8 max_index = shadow ? shadow : 8;
-    while (max_index-- > 0) {
+    // Fully addressable groups are checked for a NULL value in one go, as
+    // long as they don't contain our maximum length.
+    if (shadow == 0 && group == reinterpret_cast<uintptr_t>(addr_value) &&
+        (max_size == 0 || *size + kShadowGranularity < max_size) &&
+        !HasZeroByte(*reinterpret_cast<const uint64*>(addr_value))) {
+      addr_value += kShadowGranularity;
+      *size += kShadowGranularity;
+      continue;
+    }
+
+    const uint8* group_end = reinterpret_cast<const uint8*>(group) +
+        (shadow != 0 ? shadow : kShadowGranularity);
+    for (; addr_value < group_end; ++addr_value) {
       (*size)++;
       if (*size == max_size || *addr_value == 0)
         return true;
-      addr_value++;
     }
 
     if (shadow != 0)
@@ -187,5 +409,129 @@ bool Shadow::GetNullTerminatedArraySize(const void* addr,
   }
 }
 
+void Shadow::CommitShadowPage(size_t page) {
+  DCHECK(shadow_ != NULL);
+  DCHECK_GT(kShadowPageCount, page);
+
+  if (IsShadowPageCommitted(page))
+    return;
+
+  // Only the thread that claims the page commits and fills it. Otherwise a
+  // thread losing the race could fill it again after the winner published it
+  // and wipe the shadow bytes written to it in the meantime.
+  LONG mask = 1 << (page % 32);
+  if ((::InterlockedOr(&claimed_pages_[page / 32], mask) & mask) != 0) {
+    // Another thread is committing the page, wait for it to be published.
+    while (!IsShadowPageCommitted(page))
+      ::SwitchToThread();
+    return;
+  }
+
+  uint8* page_start = shadow_ + page * kShadowPageSize;
+  CHECK(::VirtualAlloc(page_start, kShadowPageSize, MEM_COMMIT,
+                       PAGE_READWRITE) != NULL)
+      << "Unable to commit the shadow memory.";
+
+  // Freshly committed pages are zeroed, i.e. addressable.
+  uint8 value = GetDefaultShadowByte(page);
+  if (value != 0)
+    memset(page_start, value, kShadowPageSize);
+
+  // The interlocked operation is a full barrier, so the content of the page is
+  // visible to the threads that see it as committed.
+  ::InterlockedOr(&committed_pages_[page / 32], mask);
+}
+
+void Shadow::CommitShadow(uintptr_t begin, uintptr_t end) {
+  DCHECK_LE(begin, end);
+  DCHECK_GE(kShadowSize, end);
+
+  for (size_t page = begin / kShadowPageSize; page * kShadowPageSize < end;
+       ++page) {
+    if (!IsShadowPageCommitted(page))
+      CommitShadowPage(page);
+  }
+}
+
+void Shadow::ClearShadow(uintptr_t begin, uintptr_t end) {
+  DCHECK_LE(begin, end);
+  DCHECK_GE(kShadowSize, end);
+
+  while (begin != end) {
+    size_t page = begin / kShadowPageSize;
+    uintptr_t page_end = std::min(end, (page + 1) * kShadowPageSize);
+    if (!IsShadowPageCommitted(page) && GetDefaultShadowByte(page) != 0)
+      CommitShadowPage(page);
+    if (IsShadowPageCommitted(page))
+      FillShadow(shadow_ + begin, page_end - begin, kHeapAddressableByte);
+    begin = page_end;
+  }
+}
+
+uint8 Shadow::GetDefaultShadowByte(size_t page) {
+  if (!shadow_memory_is_poisoned_)
+    return kHeapAddressableByte;
+
+  // The shadow memory is aligned to the allocation granularity, so a shadow
+  // page is either entirely in the shadow of the shadow memory or entirely
+  // out of it.
+  uintptr_t shadow_memory_begin = reinterpret_cast<uintptr_t>(shadow_) >> 3;
+  uintptr_t shadow_memory_end = shadow_memory_begin + (kShadowSize >> 3);
+  uintptr_t index = page * kShadowPageSize;
+  if (index >= shadow_memory_begin && index < shadow_memory_end)
+    return kAsanMemoryByte;
+  return kHeapAddressableByte;
+}
+
+uint8 Shadow::GetShadowByte(uintptr_t index) {
+  DCHECK(shadow_ != NULL);
+  DCHECK_GT(kShadowSize, index);
+
+  size_t page = index / kShadowPageSize;
+  if (!IsShadowPageCommitted(page))
+    return GetDefaultShadowByte(page);
+  return shadow_[index];
+}
+
+uintptr_t Shadow::FindNonZeroShadowIndex(uintptr_t begin, uintptr_t end) {
+  DCHECK_LE(begin, end);
+
+  while (begin != end) {
+    size_t page = begin / kShadowPageSize;
+    uintptr_t page_end = std::min(end, (page + 1) * kShadowPageSize);
+    if (IsShadowPageCommitted(page)) {
+      const uint8* shadow = FindNonZeroShadowByte(shadow_ + begin,
+                                                  shadow_ + page_end);
+      if (shadow != shadow_ + page_end)
+        return shadow - shadow_;
+    } else if (GetDefaultShadowByte(page) != 0) {
+      return begin;
+    }
+    begin = page_end;
+  }
+  return end;
+}
+
+LONG CALLBACK Shadow::OnException(EXCEPTION_POINTERS* exception) {
+  DCHECK(exception != NULL);
+
+  const EXCEPTION_RECORD* record = exception->ExceptionRecord;
+  if (record->ExceptionCode != EXCEPTION_ACCESS_VIOLATION ||
+      record->NumberParameters < 2) {
+    return EXCEPTION_CONTINUE_SEARCH;
+  }
+
+  // The second parameter is the address that was accessed.
+  uintptr_t address = record->ExceptionInformation[1];
+  uintptr_t shadow = reinterpret_cast<uintptr_t>(shadow_);
+  if (shadow_ == NULL || address < shadow || address >= shadow + kShadowSize)
+    return EXCEPTION_CONTINUE_SEARCH;
+
+  // The faulting instruction can simply be executed again once the page is
+  // committed.
+  CommitShadowPage((address - shadow) / kShadowPageSize);
+  return EXCEPTION_CONTINUE_EXECUTION;
+}
+
 }  // namespace asan
 }  // namespace agent
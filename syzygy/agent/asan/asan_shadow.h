@@ -16,6 +16,7 @@
 #ifndef SYZYGY_AGENT_ASAN_ASAN_SHADOW_H_
 #define SYZYGY_AGENT_ASAN_ASAN_SHADOW_H_
 
+#include <windows.h>  // NOLINT
 #include <string>
 
 #include "base/basictypes.h"
@@ -30,10 +31,12 @@ class Shadow {
    static const size_t kShadowGranularityLog = 3;
    static const size_t kShadowGranularity = 1 << kShadowGranularityLog;
 
-  // Set up the shadow memory.
+  // Set up the shadow memory. The shadow memory is only reserved here, its
+  // pages get committed as they're first written to or read by the
+  // instrumentation. Until then they read as addressable.
   static void SetUp();
 
-  // Tear down the shadow memory.
+  // Tear down the shadow memory. This releases it.
   static void TearDown();
 
   // The different markers we use to mark the shadow memory.
@@ -60,6 +63,14 @@ class Shadow {
   // @param size The size of the memory to unpoison.
   static void Unpoison(const void* addr, size_t size);
 
+  // Un-poisons @p size bytes starting at @p addr, like Unpoison, but
+  // decommits the shadow pages that only cover this range rather than
+  // zeroing them. This is meant for large ranges of memory being released.
+  // @pre addr mod 8 == 0 && size mod 8 == 0.
+  // @param addr The starting address.
+  // @param size The size of the memory to unpoison.
+  static void UnpoisonAndDecommit(const void* addr, size_t size);
+
   // Mark @p size bytes starting at @p addr as freed.
   // @param addr The starting address.
   // @param size The size of the memory to mark as freed.
@@ -70,6 +81,23 @@ class Shadow {
   // @returns true if this address is accessible, false otherwise.
   static bool IsAccessible(const void* addr);
 
+  // Returns true iff none of the @p size bytes starting at @p addr are
+  // poisoned. This inspects the shadow memory many bytes at a time, so it's
+  // much faster than calling IsAccessible for every byte of the range.
+  // @param addr The starting address of the range that we want to check.
+  // @param size The size of the range that we want to check.
+  // @returns true if the whole range is accessible, false otherwise.
+  static bool IsRangeAccessible(const void* addr, size_t size);
+
+  // Returns the first poisoned byte among the @p size bytes starting at
+  // @p addr. Like IsRangeAccessible this inspects the shadow memory in 8 and
+  // 64-byte words.
+  // @param addr The starting address of the range that we want to check.
+  // @param size The size of the range that we want to check.
+  // @returns the address of the first poisoned byte of the range, or NULL if
+  //     the whole range is accessible.
+  static const void* FindFirstPoisonedByte(const void* addr, size_t size);
+
   // Returns the ShadowMarker value for the byte at @p addr.
   // @param addr The address for which we want the ShadowMarker value.
   // @returns the ShadowMarker value for this address.
@@ -97,7 +125,8 @@ class Shadow {
                                          size_t max_size);
 
  protected:
-  // Reset the shadow memory.
+  // Reset the shadow memory, reserving it if it isn't already. This decommits
+  // all of the shadow memory, i.e. makes all the memory addressable.
   static void Reset();
 
   // Appends a line of shadow byte text for the bytes ranging from
@@ -109,10 +138,64 @@ class Shadow {
                                    std::string* output,
                                    size_t bug_index);
 
+  // @returns true iff the shadow page @p page is committed.
+  static bool IsShadowPageCommitted(size_t page) {
+    return (committed_pages_[page / 32] & (1 << (page % 32))) != 0;
+  }
+
+  // Commits the shadow page @p page. This is harmless if it's committed
+  // already. When several threads commit the same page at once only one of
+  // them initializes it, and the other ones wait until it's done.
+  static void CommitShadowPage(size_t page);
+
+  // Commits the pages holding the shadow bytes [@p begin, @p end).
+  static void CommitShadow(uintptr_t begin, uintptr_t end);
+
+  // Zeroes the shadow bytes [@p begin, @p end). The pages that aren't
+  // committed and already read as zero are left alone.
+  static void ClearShadow(uintptr_t begin, uintptr_t end);
+
+  // @returns the value of the shadow bytes of @p page while it isn't
+  //     committed.
+  static uint8 GetDefaultShadowByte(size_t page);
+
+  // @returns the shadow byte at @p index, without committing its page.
+  static uint8 GetShadowByte(uintptr_t index);
+
+  // @returns the index of the first non-zero shadow byte in
+  //     [@p begin, @p end), or @p end if they're all zero. This doesn't
+  //     commit any page.
+  static uintptr_t FindNonZeroShadowIndex(uintptr_t begin, uintptr_t end);
+
+  // Commits the shadow pages that the instrumentation reads before anything
+  // has been written to them.
+  static LONG CALLBACK OnException(EXCEPTION_POINTERS* exception);
+
   // One shadow byte for every 8 bytes in a 2G address space. By default Chrome
   // is not large address aware, so we shouldn't be using the high memory.
   static const size_t kShadowSize = 1 << (31 - kShadowGranularityLog);
-  static uint8 shadow_[kShadowSize];
+
+  // The shadow memory is committed in pages of this size.
+  static const size_t kShadowPageSize = 4096;
+  static const size_t kShadowPageCount = kShadowSize / kShadowPageSize;
+
+  // The shadow memory, reserved by SetUp. The instrumentation reads it
+  // directly.
+  static uint8* shadow_;
+
+  // A bitmap of the shadow pages that a thread has started committing.
+  static volatile LONG claimed_pages_[kShadowPageCount / 32];
+
+  // A bitmap of the committed shadow pages. A page's bit is only set once its
+  // content has been initialized.
+  static volatile LONG committed_pages_[kShadowPageCount / 32];
+
+  // True iff the shadow of the shadow memory itself reads as kAsanMemoryByte.
+  // Like the rest of the shadow it's filled in as its pages get committed.
+  static bool shadow_memory_is_poisoned_;
+
+  // The vectored exception handler that commits the shadow pages.
+  static void* exception_handler_;
 };
 
 }  // namespace asan
@@ -26,11 +26,34 @@ namespace {
 // A derived class to expose protected members for unit-testing.
 class TestShadow : public Shadow {
  public:
+  using Shadow::CommitShadowPage;
+  using Shadow::IsShadowPageCommitted;
   using Shadow::Reset;
+  using Shadow::kShadowPageSize;
   using Shadow::kShadowSize;
   using Shadow::shadow_;
 };
 
+// The parameters of a thread committing a shadow page.
+struct CommitThreadParams {
+  HANDLE start_event;
+  size_t page;
+  size_t slot;
+};
+
+DWORD WINAPI CommitThreadMain(void* param) {
+  CommitThreadParams* params = reinterpret_cast<CommitThreadParams*>(param);
+  if (::WaitForSingleObject(params->start_event, INFINITE) != WAIT_OBJECT_0)
+    return 1;
+
+  // Write to the page as soon as it's committed. This must survive the other
+  // threads committing it at the same time.
+  TestShadow::CommitShadowPage(params->page);
+  TestShadow::shadow_[params->page * TestShadow::kShadowPageSize +
+                      params->slot] = Shadow::kHeapLeftRedzone;
+  return 0;
+}
+
 }  // namespace
 
 TEST(ShadowTest, PoisonUnpoisonAccess) {
@@ -63,34 +86,186 @@ TEST(ShadowTest, PoisonUnpoisonAccess) {
   }
 }
 
-TEST(ShadowTest, SetUpAndTearDown) {
+TEST(ShadowTest, IsRangeAccessible) {
   // Reset the shadow memory.
   TestShadow::Reset();
+  const size_t kBlockSize = 4096;
+  const uint8* block = reinterpret_cast<const uint8*>(0x100000);
+
+  EXPECT_TRUE(Shadow::IsRangeAccessible(block, kBlockSize));
+  EXPECT_TRUE(Shadow::IsRangeAccessible(block + 3, 0));
+
+  for (size_t count = 0; count < 100; ++count) {
+    // Poison the tail of a random 8-byte group of the block.
+    const size_t poisoned_offset = base::RandInt(0, kBlockSize - 1);
+    const uint8* poisoned_group = block + common::AlignDown(
+        poisoned_offset, Shadow::kShadowGranularity);
+    const uint8* poisoned_end = poisoned_group + Shadow::kShadowGranularity;
+    Shadow::Poison(block + poisoned_offset,
+                   poisoned_end - (block + poisoned_offset),
+                   Shadow::kHeapRightRedzone);
+
+    for (size_t i = 0; i < 20; ++i) {
+      const size_t offset = base::RandInt(0, kBlockSize - 1);
+      const size_t size = base::RandInt(1, kBlockSize - offset);
+      // Compare with a byte by byte check of the range.
+      bool expected = true;
+      for (size_t j = offset; j < offset + size; ++j) {
+        if (!Shadow::IsAccessible(block + j)) {
+          expected = false;
+          break;
+        }
+      }
+      EXPECT_EQ(expected, Shadow::IsRangeAccessible(block + offset, size));
+    }
+
+    Shadow::Unpoison(poisoned_group, Shadow::kShadowGranularity);
+  }
+}
+
+TEST(ShadowTest, FindFirstPoisonedByte) {
+  // Reset the shadow memory.
+  TestShadow::Reset();
+  const size_t kBlockSize = 4096;
+  const uint8* block = reinterpret_cast<const uint8*>(0x100000);
+
+  EXPECT_EQ(NULL, Shadow::FindFirstPoisonedByte(block, kBlockSize));
+  EXPECT_EQ(NULL, Shadow::FindFirstPoisonedByte(block + 3, 0));
+
+  // Poison the tails of two 8-byte groups, the second one fully.
+  Shadow::Poison(block + 1003, 5, Shadow::kHeapRightRedzone);
+  Shadow::Poison(block + 2048, 8, Shadow::kHeapLeftRedzone);
+
+  EXPECT_EQ(block + 1003, Shadow::FindFirstPoisonedByte(block, kBlockSize));
+  EXPECT_EQ(block + 1003, Shadow::FindFirstPoisonedByte(block + 1001, 3));
+  EXPECT_EQ(block + 1005, Shadow::FindFirstPoisonedByte(block + 1005, 2));
+  EXPECT_EQ(NULL, Shadow::FindFirstPoisonedByte(block + 1001, 2));
+  EXPECT_EQ(NULL, Shadow::FindFirstPoisonedByte(block + 1008, 1040));
+  EXPECT_EQ(block + 2048, Shadow::FindFirstPoisonedByte(block + 1008, 1041));
+  EXPECT_EQ(block + 2050, Shadow::FindFirstPoisonedByte(block + 2050, 100));
+  EXPECT_EQ(NULL, Shadow::FindFirstPoisonedByte(block + 2056, 2040));
+
+  // Compare with a byte by byte search over random ranges.
+  for (size_t i = 0; i < 1000; ++i) {
+    const size_t offset = base::RandInt(0, kBlockSize - 1);
+    const size_t size = base::RandInt(1, kBlockSize - offset);
+    const void* expected = NULL;
+    for (size_t j = offset; j < offset + size; ++j) {
+      if (!Shadow::IsAccessible(block + j)) {
+        expected = block + j;
+        break;
+      }
+    }
+    EXPECT_EQ(expected, Shadow::FindFirstPoisonedByte(block + offset, size));
+  }
 
+  Shadow::Unpoison(block, kBlockSize);
+}
+
+TEST(ShadowTest, SetUpAndTearDown) {
   // Don't check all the shadow bytes otherwise this test will take too much
   // time.
   const size_t kLookupInterval = 25;
 
-  intptr_t shadow_array_start = reinterpret_cast<intptr_t>(TestShadow::shadow_);
-  size_t shadow_start = shadow_array_start >> 3;
-  size_t shadow_end = shadow_start + (TestShadow::kShadowSize >> 3);
-
-  const size_t non_addressable_memory_end = (0x10000 >> 3);
-
   Shadow::SetUp();
-  for (size_t i = shadow_start; i < shadow_end; i += kLookupInterval) {
-    ASSERT_EQ(Shadow::kAsanMemoryByte, TestShadow::shadow_[i]);
+  const uint8* shadow_memory = TestShadow::shadow_;
+  ASSERT_TRUE(shadow_memory != NULL);
+  for (size_t i = 0; i < TestShadow::kShadowSize;
+       i += kLookupInterval << Shadow::kShadowGranularityLog) {
+    ASSERT_EQ(Shadow::kAsanMemoryByte,
+              Shadow::GetShadowMarkerForAddress(shadow_memory + i));
   }
-  for (size_t i = 0; i < non_addressable_memory_end; i += kLookupInterval) {
-    ASSERT_EQ(Shadow::kInvalidAddress, TestShadow::shadow_[i]);
+  for (size_t i = 0; i < 0x10000; i += kLookupInterval) {
+    ASSERT_EQ(Shadow::kInvalidAddress,
+              Shadow::GetShadowMarkerForAddress(reinterpret_cast<void*>(i)));
   }
+
+  // Reading the shadow of the shadow memory directly, as the instrumentation
+  // does, commits it with the right content.
+  uintptr_t index = reinterpret_cast<uintptr_t>(shadow_memory) >>
+      Shadow::kShadowGranularityLog;
+  EXPECT_EQ(Shadow::kAsanMemoryByte, TestShadow::shadow_[index]);
+
   Shadow::TearDown();
-  for (size_t i = shadow_start; i < shadow_end; i += kLookupInterval) {
-    ASSERT_EQ(Shadow::kHeapAddressableByte, TestShadow::shadow_[i]);
+  EXPECT_TRUE(TestShadow::shadow_ == NULL);
+}
+
+TEST(ShadowTest, ShadowIsCommittedOnDemand) {
+  // Reset the shadow memory.
+  TestShadow::Reset();
+
+  // None of the shadow memory is committed after a reset.
+  MEMORY_BASIC_INFORMATION info = {};
+  ASSERT_EQ(sizeof(info),
+            ::VirtualQuery(TestShadow::shadow_, &info, sizeof(info)));
+  EXPECT_EQ(MEM_RESERVE, info.State);
+  EXPECT_EQ(TestShadow::kShadowSize, info.RegionSize);
+
+  // Poisoning some memory only commits the shadow page covering it.
+  uint8* addr = reinterpret_cast<uint8*>(0x10000000);
+  Shadow::Poison(addr, 64, Shadow::kHeapLeftRedzone);
+  const uint8* shadow = TestShadow::shadow_ +
+      (reinterpret_cast<uintptr_t>(addr) >> Shadow::kShadowGranularityLog);
+  ASSERT_EQ(sizeof(info), ::VirtualQuery(shadow, &info, sizeof(info)));
+  EXPECT_EQ(MEM_COMMIT, info.State);
+  EXPECT_EQ(TestShadow::kShadowPageSize, info.RegionSize);
+  EXPECT_FALSE(Shadow::IsAccessible(addr));
+  EXPECT_EQ(addr, Shadow::FindFirstPoisonedByte(addr - 8, 16));
+
+  // The memory whose shadow isn't committed is addressable, and checking it
+  // leaves its shadow uncommitted.
+  const size_t kRangeSize = 64 * 1024 * 1024;
+  EXPECT_TRUE(Shadow::IsAccessible(addr + kRangeSize));
+  EXPECT_TRUE(Shadow::IsRangeAccessible(addr + 64, kRangeSize));
+  ASSERT_EQ(sizeof(info), ::VirtualQuery(shadow + TestShadow::kShadowPageSize,
+                                         &info, sizeof(info)));
+  EXPECT_EQ(MEM_RESERVE, info.State);
+
+  Shadow::Unpoison(addr, 64);
+  EXPECT_TRUE(Shadow::IsAccessible(addr));
+}
+
+TEST(ShadowTest, ConcurrentCommitInitializesPageOnce) {
+  const size_t kNumThreads = 16;
+
+  // Use a page of the shadow of the shadow memory, as it's filled with
+  // kAsanMemoryByte when it gets committed.
+  Shadow::SetUp();
+  size_t page = (reinterpret_cast<uintptr_t>(TestShadow::shadow_) >>
+      Shadow::kShadowGranularityLog) / TestShadow::kShadowPageSize;
+  ASSERT_FALSE(TestShadow::IsShadowPageCommitted(page));
+
+  HANDLE start_event = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+  ASSERT_TRUE(start_event != NULL);
+  CommitThreadParams params[kNumThreads] = {};
+  HANDLE threads[kNumThreads] = {};
+  for (size_t i = 0; i < kNumThreads; ++i) {
+    CommitThreadParams thread_params = { start_event, page, i };
+    params[i] = thread_params;
+    threads[i] = ::CreateThread(NULL, 0, &CommitThreadMain, &params[i], 0,
+                                NULL);
+    ASSERT_TRUE(threads[i] != NULL);
   }
-  for (size_t i = 0; i < non_addressable_memory_end; i += kLookupInterval) {
-    ASSERT_EQ(Shadow::kHeapAddressableByte, TestShadow::shadow_[i]);
+  ASSERT_TRUE(::SetEvent(start_event) == TRUE);
+  ASSERT_EQ(WAIT_OBJECT_0,
+            ::WaitForMultipleObjects(kNumThreads, threads, TRUE, INFINITE));
+  for (size_t i = 0; i < kNumThreads; ++i) {
+    DWORD exit_code = 0;
+    EXPECT_TRUE(::GetExitCodeThread(threads[i], &exit_code) == TRUE);
+    EXPECT_EQ(0u, exit_code);
+    ::CloseHandle(threads[i]);
   }
+  ::CloseHandle(start_event);
+
+  // None of the writes got wiped by a late initialization of the page.
+  EXPECT_TRUE(TestShadow::IsShadowPageCommitted(page));
+  const uint8* page_start =
+      TestShadow::shadow_ + page * TestShadow::kShadowPageSize;
+  for (size_t i = 0; i < kNumThreads; ++i)
+    EXPECT_EQ(Shadow::kHeapLeftRedzone, page_start[i]);
+  EXPECT_EQ(Shadow::kAsanMemoryByte, page_start[kNumThreads]);
+
+  Shadow::TearDown();
 }
 
 TEST(ShadowTest, GetNullTerminatedArraySize) {
@@ -14,6 +14,8 @@
 
 #include "syzygy/agent/asan/stack_capture.h"
 
+#include <intrin.h>
+
 #include "base/logging.h"
 #include "base/process_util.h"
 
@@ -76,6 +78,59 @@ void StackCapture::InitFromBuffer(StackId stack_id,
   ::memcpy(frames_, frames, num_frames_ * sizeof(void*));
 }
 
+// The walk starts from the frame of InitFromFramePointers, so it must keep a
+// frame pointer even where frame pointer omission is enabled.
+#pragma optimize("y", off)
+void StackCapture::InitFromFramePointers() {
+  // The stack of the current thread spans [StackLimit, StackBase).
+  const NT_TIB* tib = reinterpret_cast<const NT_TIB*>(::NtCurrentTeb());
+  void* const* stack_base = reinterpret_cast<void* const*>(tib->StackBase);
+
+  // Each frame holds the frame pointer of the caller, followed by the return
+  // address into the caller. Our own frame sits right below our return
+  // address.
+  void* const* frame =
+      reinterpret_cast<void* const*>(_AddressOfReturnAddress()) - 1;
+  StackId stack_id = 0;
+  size_t num_frames = 0;
+  while (num_frames < max_num_frames_) {
+    void* return_address = frame[1];
+    if (return_address == NULL)
+      break;
+    frames_[num_frames++] = return_address;
+    stack_id += reinterpret_cast<StackId>(return_address);
+
+    // The stack grows downwards, so the frame of the caller must be further
+    // up the stack, and entirely within it.
+    void* const* next_frame = reinterpret_cast<void* const*>(frame[0]);
+    if (next_frame <= frame || next_frame + 2 > stack_base ||
+        reinterpret_cast<uintptr_t>(next_frame) % sizeof(void*) != 0) {
+      break;
+    }
+    frame = next_frame;
+  }
+
+  if (num_frames <= 1) {
+    // Skip our own frame, so that the trace starts in the caller as well.
+    num_frames = ::CaptureStackBackTrace(1, max_num_frames_, frames_, NULL);
+    stack_id = ComputeStackTraceHash(frames_, static_cast<uint8>(num_frames));
+  }
+
+  // Drop the bottom frames, and their contribution to the stack ID.
+  if (num_frames > bottom_frames_to_skip_) {
+    for (size_t i = num_frames - bottom_frames_to_skip_; i < num_frames; ++i)
+      stack_id -= reinterpret_cast<StackId>(frames_[i]);
+    num_frames -= bottom_frames_to_skip_;
+  } else {
+    num_frames = 1;
+    stack_id = reinterpret_cast<StackId>(frames_[0]);
+  }
+
+  num_frames_ = static_cast<uint8>(num_frames);
+  stack_id_ = stack_id;
+}
+#pragma optimize("", on)
+
 StackCapture::StackId StackCapture::ComputeRelativeStackId() {
   // We want to ignore the frames relative to our module to be able to get the
   // same trace id even if we update our runtime.
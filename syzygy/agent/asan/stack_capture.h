@@ -154,6 +154,18 @@ class StackCapture {
     stack_id_ = ComputeStackTraceHash(frames_, num_frames_);
   }
 
+  // Initializes a stack trace by chasing the chain of frame pointers on the
+  // current thread's stack, which is much cheaper than
+  // ::CaptureStackBackTrace. The stack ID is computed along the way. The walk
+  // ends at the first frame pointer that doesn't refer to a frame further up
+  // the thread's stack, or after max_num_frames() frames. If the walk can't
+  // get past the caller, e.g. because it omits frame pointers, this falls back
+  // to ::CaptureStackBackTrace.
+  // @note As with InitFromStack, the trace starts in the caller. This is the
+  //     reason why this can't be inlined: the walk starts from the frame of
+  //     this function.
+  __declspec(noinline) void InitFromFramePointers();
+
   // The hash comparison functor for use with MSDN's stdext::hash_set.
   struct HashCompare {
     static const size_t bucket_size = 4;
@@ -35,6 +35,13 @@ StackCapture** GetFirstFrameAsLink(StackCapture* stack_capture) {
   return link;
 }
 
+// @returns the shard, among @p shard_count of them, that the current thread
+//     hashes to.
+size_t GetThreadShard(size_t shard_count) {
+  // Thread ids are multiples of 4, so drop the bits that never vary.
+  return (::GetCurrentThreadId() >> 2) % shard_count;
+}
+
 }  // namespace
 
 size_t StackCaptureCache::compression_reporting_period_ =
@@ -80,35 +87,31 @@ bool StackCaptureCache::CachePage::ReturnStackCapture(
 StackCaptureCache::StackCaptureCache(AsanLogger* logger)
     : logger_(logger),
       max_num_frames_(StackCapture::kMaxNumFrames),
-      current_page_(new CachePage(NULL)) {
-  CHECK(current_page_ != NULL);
+      report_counter_(0) {
   DCHECK(logger_ != NULL);
-  ::memset(&statistics_, 0, sizeof(statistics_));
   ::memset(reclaimed_, 0, sizeof(reclaimed_));
-  statistics_.size = sizeof(CachePage);
 }
 
 StackCaptureCache::StackCaptureCache(AsanLogger* logger, size_t max_num_frames)
     : logger_(logger),
       max_num_frames_(0),
-      current_page_(new CachePage(NULL)) {
-  CHECK(current_page_ != NULL);
+      report_counter_(0) {
   DCHECK(logger_ != NULL);
   DCHECK_LT(0u, max_num_frames);
   max_num_frames_ = static_cast<uint8>(
       std::min(max_num_frames, StackCapture::kMaxNumFrames));
-  ::memset(&statistics_, 0, sizeof(statistics_));
   ::memset(reclaimed_, 0, sizeof(reclaimed_));
-  statistics_.size = sizeof(CachePage);
 }
 
 StackCaptureCache::~StackCaptureCache() {
-  // Clean up the linked list of cache pages.
-  while (current_page_ != NULL) {
-    CachePage* page = current_page_;
-    current_page_ = page->next_page_;
-    page->next_page_ = NULL;
-    delete page;
+  // Clean up the linked lists of cache pages.
+  for (size_t i = 0; i < kPageSharding; ++i) {
+    while (page_shards_[i].current_page != NULL) {
+      CachePage* page = page_shards_[i].current_page;
+      page_shards_[i].current_page = page->next_page_;
+      page->next_page_ = NULL;
+      delete page;
+    }
   }
 }
 
@@ -120,7 +123,6 @@ const StackCapture* StackCaptureCache::SaveStackTrace(
     StackId stack_id, const void* const* frames, size_t num_frames) {
   DCHECK(frames != NULL);
   DCHECK_NE(num_frames, 0U);
-  DCHECK(current_page_ != NULL);
 
   bool already_cached = false;
   StackCapture* stack_trace = NULL;
@@ -164,29 +166,33 @@ const StackCapture* StackCaptureCache::SaveStackTrace(
   Statistics statistics = {};
   // Update the statistics.
   if (compression_reporting_period_ != 0) {
-    base::AutoLock stats_lock(stats_lock_);
-    if (already_cached) {
-      // If the existing stack capture is previously unreferenced and becoming
-      // referenced again, then decrement the unreferenced counter.
-      if (stack_trace->HasNoRefs()) {
-        DCHECK_LT(0u, statistics_.unreferenced);
-        --statistics_.unreferenced;
+    StatisticsShard* shard = GetStatisticsShard();
+    {
+      base::AutoLock stats_lock(shard->lock);
+      if (already_cached) {
+        // If the existing stack capture is previously unreferenced and
+        // becoming referenced again, then decrement the unreferenced counter.
+        if (stack_trace->HasNoRefs())
+          --shard->statistics.unreferenced;
+      } else {
+        ++shard->statistics.cached;
+        shard->statistics.frames_alive += num_frames;
+        ++shard->statistics.allocated;
       }
-    } else {
-      ++statistics_.cached;
-      statistics_.frames_alive += num_frames;
-      ++statistics_.allocated;
-    }
-    if (!saturated && stack_trace->RefCountIsSaturated()) {
-      saturated = true;
-      ++statistics_.saturated;
+      if (!saturated && stack_trace->RefCountIsSaturated()) {
+        saturated = true;
+        ++shard->statistics.saturated;
+      }
+      ++shard->statistics.requested;
+      ++shard->statistics.references;
+      shard->statistics.frames_stored += num_frames;
     }
-    ++statistics_.requested;
-    ++statistics_.references;
-    statistics_.frames_stored += num_frames;
-    if (statistics_.requested % compression_reporting_period_ == 0) {
+
+    ULONG requested = static_cast<ULONG>(
+        ::InterlockedIncrement(&report_counter_));
+    if (requested % compression_reporting_period_ == 0) {
       must_log = true;
-      GetStatisticsUnlocked(&statistics);
+      GetStatistics(&statistics);
     }
   }
 
@@ -236,37 +242,49 @@ void StackCaptureCache::ReleaseStackTrace(const StackCapture* stack_capture) {
 
   // Update the statistics.
   if (compression_reporting_period_ != 0) {
-    base::AutoLock stats_lock(stats_lock_);
-    DCHECK_LT(0u, statistics_.references);
-    --statistics_.references;
-    statistics_.frames_stored -= stack->num_frames();
+    StatisticsShard* shard = GetStatisticsShard();
+    base::AutoLock stats_lock(shard->lock);
+    --shard->statistics.references;
+    shard->statistics.frames_stored -= stack->num_frames();
     if (add_to_reclaimed_list) {
-      --statistics_.cached;
-      ++statistics_.unreferenced;
+      --shard->statistics.cached;
+      ++shard->statistics.unreferenced;
       // The frames in this stack capture are no longer alive.
-      statistics_.frames_alive -= stack->num_frames();
+      shard->statistics.frames_alive -= stack->num_frames();
     }
   }
 }
 
 void StackCaptureCache::LogStatistics()  {
   Statistics statistics = {};
-
-  {
-    base::AutoLock auto_lock(stats_lock_);
-    GetStatisticsUnlocked(&statistics);
-  }
-
+  GetStatistics(&statistics);
   LogStatisticsImpl(statistics);
 }
 
-void StackCaptureCache::GetStatisticsUnlocked(Statistics* statistics) const {
-#ifndef NDEBUG
-  stats_lock_.AssertAcquired();
-#endif
-
+void StackCaptureCache::GetStatistics(Statistics* statistics) const {
   DCHECK(statistics != NULL);
-  *statistics = statistics_;
+  ::memset(statistics, 0, sizeof(*statistics));
+
+  // The shards are summed one at a time, so this isn't an atomic snapshot of
+  // the cache. It's good enough for reporting purposes.
+  for (size_t i = 0; i < kStatisticsSharding; ++i) {
+    const StatisticsShard& shard = statistics_shards_[i];
+    base::AutoLock stats_lock(shard.lock);
+    statistics->cached += shard.statistics.cached;
+    statistics->size += shard.statistics.size;
+    statistics->saturated += shard.statistics.saturated;
+    statistics->unreferenced += shard.statistics.unreferenced;
+    statistics->requested += shard.statistics.requested;
+    statistics->allocated += shard.statistics.allocated;
+    statistics->references += shard.statistics.references;
+    statistics->frames_stored += shard.statistics.frames_stored;
+    statistics->frames_alive += shard.statistics.frames_alive;
+    statistics->frames_dead += shard.statistics.frames_dead;
+  }
+}
+
+StackCaptureCache::StatisticsShard* StackCaptureCache::GetStatisticsShard() {
+  return &statistics_shards_[GetThreadShard(kStatisticsSharding)];
 }
 
 void StackCaptureCache::LogStatisticsImpl(const Statistics& statistics) const {
@@ -321,45 +339,49 @@ StackCapture* StackCaptureCache::GetStackCapture(size_t num_frames) {
 
   if (stack_capture != NULL) {
     if (compression_reporting_period_ != 0) {
-      base::AutoLock stats_lock(stats_lock_);
+      StatisticsShard* shard = GetStatisticsShard();
+      base::AutoLock stats_lock(shard->lock);
       // These frames are no longer dead, but in limbo. If the stack capture
       // is used they'll be added to frames_alive and frames_stored.
-      statistics_.frames_dead -= stack_capture->max_num_frames();
+      shard->statistics.frames_dead -= stack_capture->max_num_frames();
     }
     return stack_capture;
   }
 
   StackCapture* unused_stack_capture = NULL;
+  PageShard* page_shard = &page_shards_[GetThreadShard(kPageSharding)];
   {
-    base::AutoLock current_page_lock(current_page_lock_);
+    base::AutoLock current_page_lock(page_shard->lock);
 
     // We didn't find a reusable stack capture. Go to the cache page.
-    stack_capture = current_page_->GetNextStackCapture(num_frames);
-
-    if (stack_capture != NULL)
-      return stack_capture;
-
-    // If the allocation failed we don't have enough room on the current page.
-
-    // Use the remaining bytes to create one more maximally sized stack
-    // capture. We will stuff this into the reclaimed_ structure for later
-    // use.
-    size_t bytes_left = current_page_->bytes_left();
-    size_t max_num_frames = StackCapture::GetMaxNumFrames(bytes_left);
-    if (max_num_frames > 0) {
-      DCHECK_LT(max_num_frames, num_frames);
-      DCHECK_LE(StackCapture::GetSize(max_num_frames), bytes_left);
-      unused_stack_capture =
-          current_page_->GetNextStackCapture(max_num_frames);
-      DCHECK(unused_stack_capture != NULL);
+    CachePage* current_page = page_shard->current_page;
+    if (current_page != NULL) {
+      stack_capture = current_page->GetNextStackCapture(num_frames);
+      if (stack_capture != NULL)
+        return stack_capture;
+
+      // If the allocation failed we don't have enough room on the current
+      // page.
+
+      // Use the remaining bytes to create one more maximally sized stack
+      // capture. We will stuff this into the reclaimed_ structure for later
+      // use.
+      size_t bytes_left = current_page->bytes_left();
+      size_t max_num_frames = StackCapture::GetMaxNumFrames(bytes_left);
+      if (max_num_frames > 0) {
+        DCHECK_LT(max_num_frames, num_frames);
+        DCHECK_LE(StackCapture::GetSize(max_num_frames), bytes_left);
+        unused_stack_capture =
+            current_page->GetNextStackCapture(max_num_frames);
+        DCHECK(unused_stack_capture != NULL);
+      }
     }
 
     // Allocate a new page (that links to the current page) and use it to
     // allocate a new stack capture.
-    current_page_ = new CachePage(current_page_);
-    CHECK(current_page_ != NULL);
-    statistics_.size += sizeof(CachePage);
-    stack_capture = current_page_->GetNextStackCapture(num_frames);
+    page_shard->current_page = new CachePage(current_page);
+    CHECK(page_shard->current_page != NULL);
+    stack_capture = page_shard->current_page->GetNextStackCapture(num_frames);
   }
 
   if (unused_stack_capture != NULL) {
@@ -367,10 +389,16 @@ StackCapture* StackCaptureCache::GetStackCapture(size_t num_frames) {
     AddStackCaptureToReclaimedList(unused_stack_capture);
   }
 
-  // Update the statistics.
-  if (compression_reporting_period_ != 0) {
-    base::AutoLock stats_lock(stats_lock_);
-    ++statistics_.unreferenced;
+  // Update the statistics. The size of the cache is tracked regardless of
+  // the reporting period. As the pages are allocated lazily the first page
+  // of a shard doesn't leave an unused stack capture behind, so only the one
+  // stuffed into the reclaimed list is counted as unreferenced.
+  {
+    StatisticsShard* shard = GetStatisticsShard();
+    base::AutoLock stats_lock(shard->lock);
+    shard->statistics.size += sizeof(CachePage);
+    if (compression_reporting_period_ != 0 && unused_stack_capture != NULL)
+      ++shard->statistics.unreferenced;
   }
 
   DCHECK(stack_capture != NULL);
@@ -391,8 +419,9 @@ void StackCaptureCache::AddStackCaptureToReclaimedList(
 
   // Update the statistics.
   if (compression_reporting_period_ != 0) {
-    base::AutoLock stats_lock(stats_lock_);
-    statistics_.frames_dead += stack_capture->max_num_frames();
+    StatisticsShard* shard = GetStatisticsShard();
+    base::AutoLock stats_lock(shard->lock);
+    shard->statistics.frames_dead += stack_capture->max_num_frames();
   }
 }
 
@@ -120,13 +120,15 @@ class StackCaptureCache {
   struct Statistics {
     // The total number of stacks currently in the cache.
     size_t cached;
-    // The current total size of the stack cache, in bytes.
+    // The current total size of the stack cache, in bytes. The cache pages
+    // are allocated lazily, so this is zero until a stack is first cached.
     size_t size;
     // The total number of reference-saturated stack captures. These will never
     // be able to be removed from the cache.
     size_t saturated;
     // The number of currently unreferenced stack captures. These are pending
-    // cleanup.
+    // cleanup. This includes the stack capture carved out of the end of a
+    // full cache page, if it's big enough to hold a frame.
     size_t unreferenced;
 
     // We use 64-bit integers for the following because they can overflow a
@@ -160,22 +162,54 @@ class StackCaptureCache {
     // @}
   };
 
-  // Gets the current cache statistics. This must be called under lock_.
+  // The statistics are split in shards, selected by hashing the current
+  // thread id, so that updating them doesn't serialize all of the threads.
+  // The counters of a given shard may wrap around, as for example a stack
+  // capture can be referenced from one thread and released from another, but
+  // summing them over all of the shards always yields the right values.
+  struct StatisticsShard {
+    StatisticsShard() : statistics() {
+    }
+
+    // Protects the shard.
+    mutable base::Lock lock;
+    // The statistics accumulated in this shard. Accessed under lock.
+    Statistics statistics;
+  };
+
+  // The current page of stack captures used by the threads hashing to a
+  // given allocation shard.
+  struct PageShard {
+    PageShard() : current_page(NULL) {
+    }
+
+    // Protects the shard.
+    base::Lock lock;
+    // The current page from which new stack captures are allocated, and the
+    // head of the list of pages allocated by this shard. Accessed under lock.
+    CachePage* current_page;
+  };
+
+  // Gets the current cache statistics, summed over all of the shards.
   // @param statistics Will be populated with current cache statistics.
-  void GetStatisticsUnlocked(Statistics* statistics) const;
+  void GetStatistics(Statistics* statistics) const;
+
+  // @returns the statistics shard to be updated by the current thread.
+  StatisticsShard* GetStatisticsShard();
 
   // Implementation function for logging statistics.
   // @param report The statistics to be reported.
   void LogStatisticsImpl(const Statistics& statistics) const;
 
-  // Grabs a temporary StackCapture from reclaimed_ or the current CachePage.
-  // Must be called under lock_. Takes care of updating frames_dead.
+  // Grabs a temporary StackCapture from reclaimed_ or the current CachePage
+  // of the current thread's shard. Must be called under the lock of the known
+  // stacks shard it's meant for. Takes care of updating frames_dead.
   // @param num_frames The minimum number of frames that are required.
   StackCapture* GetStackCapture(size_t num_frames);
 
   // Links a stack capture into the reclaimed_ list. Meant to be called by
-  // ReturnStackCapture only. Must be called under lock_. Takes care of updating
-  // frames_dead (on behalf of ReturnStackCapture).
+  // ReturnStackCapture only. Takes care of updating frames_dead (on behalf of
+  // ReturnStackCapture).
   // @param stack_capture The stack capture to be linked into reclaimed_.
   void AddStackCaptureToReclaimedList(StackCapture* stack_capture);
 
@@ -186,6 +220,13 @@ class StackCaptureCache {
   // The default number of known stacks sets that we keep.
   static const size_t kKnownStacksSharding = 16;
 
+  // The number of statistics shards.
+  static const size_t kStatisticsSharding = 16;
+
+  // The number of stack capture allocation shards. Each of these has a
+  // current CachePage of its own, so this is kept small.
+  static const size_t kPageSharding = 4;
+
   // The number of allocations between reports of the stack trace cache
   // compression ratio. Zero (0) means do not report. Values like 1 million
   // seem to be pretty good with Chrome.
@@ -204,18 +245,16 @@ class StackCaptureCache {
   // The sets of known stacks. Accessed under known_stacks_locks_.
   StackSet known_stacks_[kKnownStacksSharding];
 
-  // A lock protecting access to current_page_.
-  base::Lock current_page_lock_;
-
-  // The current page from which new stack captures are allocated.
-  // Accessed under current_page_lock_.
-  CachePage* current_page_;
+  // The stack capture allocation shards. The pages are allocated lazily.
+  PageShard page_shards_[kPageSharding];
 
-  // A lock protecting access to statistics_.
-  mutable base::Lock stats_lock_;
+  // Statistics about the cache, to be summed over all of the shards.
+  StatisticsShard statistics_shards_[kStatisticsSharding];
 
-  // Aggregate statistics about the cache. Accessed under stats_lock_.
-  Statistics statistics_;
+  // The number of stack traces saved so far, modulo 2^32. This is used to
+  // determine when to report the cache statistics, and is only ever modified
+  // with interlocked operations.
+  volatile LONG report_counter_;
 
   // Locks to protect each reclaimed list from concurrent access.
   base::Lock reclaimed_locks_[StackCapture::kMaxNumFrames + 1];
@@ -33,12 +33,8 @@ class TestStackCaptureCache : public StackCaptureCache {
   }
 
   using StackCaptureCache::Statistics;
-
-  void GetStatistics(Statistics* s) {
-    DCHECK(s != NULL);
-    base::AutoLock auto_lock(stats_lock_);
-    GetStatisticsUnlocked(s);
-  }
+  using StackCaptureCache::GetStackCapture;
+  using StackCaptureCache::GetStatistics;
 };
 
 class StackCaptureCacheTest : public testing::Test {
@@ -203,6 +199,8 @@ TEST_F(StackCaptureCacheTest, Statistics) {
   EXPECT_EQ(0u, s.frames_stored);
   EXPECT_EQ(0u, s.frames_alive);
   EXPECT_EQ(0u, s.frames_dead);
+  // No cache page has been allocated yet.
+  EXPECT_EQ(0u, s.size);
 
   // Grab a stack capture and insert it.
   StackCapture stack_capture;
@@ -212,6 +210,7 @@ TEST_F(StackCaptureCacheTest, Statistics) {
   size_t s1_frames = s1->num_frames();
   cache.GetStatistics(&s);
   EXPECT_EQ(1u, s.cached);
+  EXPECT_EQ(sizeof(TestStackCaptureCache::CachePage), s.size);
   EXPECT_EQ(0u, s.saturated);
   EXPECT_EQ(0u, s.unreferenced);
   EXPECT_EQ(1u, s.requested);
@@ -318,6 +317,89 @@ TEST_F(StackCaptureCacheTest, Statistics) {
   EXPECT_EQ(s1_frames, s.frames_dead);
 }
 
+namespace {
+
+// The parameters of a thread releasing a stack capture.
+struct ReleaseThreadParams {
+  StackCaptureCache* cache;
+  const StackCapture* stack_capture;
+};
+
+DWORD WINAPI ReleaseThreadMain(void* param) {
+  ReleaseThreadParams* params = reinterpret_cast<ReleaseThreadParams*>(param);
+  params->cache->ReleaseStackTrace(params->stack_capture);
+  return 0;
+}
+
+}  // namespace
+
+TEST_F(StackCaptureCacheTest, StatisticsAcrossThreads) {
+  AsanLogger logger;
+  TestStackCaptureCache cache(&logger);
+  cache.set_compression_reporting_period(1U);
+  TestStackCaptureCache::Statistics s = {};
+
+  StackCapture stack_capture;
+  stack_capture.InitFromStack();
+  const StackCapture* s1 = cache.SaveStackTrace(stack_capture);
+  ASSERT_TRUE(s1 != NULL);
+  size_t s1_frames = s1->num_frames();
+
+  // Release the stack capture from another thread, which may account for it
+  // in another statistics shard.
+  ReleaseThreadParams params = { &cache, s1 };
+  HANDLE thread = ::CreateThread(NULL, 0, &ReleaseThreadMain, &params, 0,
+                                 NULL);
+  ASSERT_TRUE(thread != NULL);
+  ASSERT_EQ(WAIT_OBJECT_0, ::WaitForSingleObject(thread, INFINITE));
+  ::CloseHandle(thread);
+
+  cache.GetStatistics(&s);
+  EXPECT_EQ(0u, s.cached);
+  EXPECT_EQ(1u, s.unreferenced);
+  EXPECT_EQ(1u, s.requested);
+  EXPECT_EQ(1u, s.allocated);
+  EXPECT_EQ(0u, s.references);
+  EXPECT_EQ(0u, s.frames_stored);
+  EXPECT_EQ(0u, s.frames_alive);
+  EXPECT_EQ(s1_frames, s.frames_dead);
+  EXPECT_EQ(sizeof(TestStackCaptureCache::CachePage), s.size);
+}
+
+TEST_F(StackCaptureCacheTest, StatisticsOnFullPage) {
+  AsanLogger logger;
+  TestStackCaptureCache cache(&logger);
+  cache.set_compression_reporting_period(1U);
+  TestStackCaptureCache::Statistics s = {};
+  size_t max_num_frames = cache.max_num_frames();
+
+  // Figure out how many maximally sized stack captures fit in a page, and
+  // whether the remaining bytes can hold a smaller one.
+  scoped_ptr<TestStackCaptureCache::CachePage> page(
+      new TestStackCaptureCache::CachePage(NULL));
+  size_t captures_per_page = 0;
+  while (page->GetNextStackCapture(max_num_frames) != NULL)
+    ++captures_per_page;
+  size_t left_frames = StackCapture::GetMaxNumFrames(page->bytes_left());
+  ASSERT_LT(0u, captures_per_page);
+
+  // Fill the first page of the current thread's shard.
+  for (size_t i = 0; i < captures_per_page; ++i)
+    ASSERT_TRUE(cache.GetStackCapture(max_num_frames) != NULL);
+  cache.GetStatistics(&s);
+  EXPECT_EQ(sizeof(TestStackCaptureCache::CachePage), s.size);
+  EXPECT_EQ(0u, s.unreferenced);
+  EXPECT_EQ(0u, s.frames_dead);
+
+  // The next stack capture goes to a new page, and the end of the full page
+  // is reclaimed as an unreferenced stack capture.
+  ASSERT_TRUE(cache.GetStackCapture(max_num_frames) != NULL);
+  cache.GetStatistics(&s);
+  EXPECT_EQ(2 * sizeof(TestStackCaptureCache::CachePage), s.size);
+  EXPECT_EQ(left_frames > 0 ? 1u : 0u, s.unreferenced);
+  EXPECT_EQ(left_frames, s.frames_dead);
+}
+
 TEST_F(StackCaptureCacheTest, CachePagesArePoisoned) {
   scoped_ptr<TestStackCaptureCache::CachePage> page(
       new TestStackCaptureCache::CachePage(NULL));
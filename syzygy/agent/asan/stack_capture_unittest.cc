@@ -14,6 +14,8 @@
 
 #include "syzygy/agent/asan/stack_capture.h"
 
+#include <algorithm>
+
 #include "base/memory/scoped_ptr.h"
 #include "gtest/gtest.h"
 
@@ -97,5 +99,36 @@ TEST_F(StackCaptureTest, RestrictedFrameCount) {
   EXPECT_EQ(5u, capture.max_num_frames());
 }
 
+TEST_F(StackCaptureTest, InitFromFramePointers) {
+  StackCapture capture;
+  capture.InitFromFramePointers();
+  EXPECT_TRUE(capture.IsValid());
+  EXPECT_LT(1u, capture.num_frames());
+  EXPECT_EQ(StackCapture::kMaxNumFrames, capture.max_num_frames());
+
+  // The stack ID is computed along the walk.
+  void* frames[StackCapture::kMaxNumFrames] = {};
+  std::copy(capture.frames(), capture.frames() + capture.num_frames(), frames);
+  EXPECT_EQ(ComputeStackTraceHash(frames, capture.num_frames()),
+            capture.stack_id());
+
+  // The bottom frames are dropped from the trace, and from its ID.
+  StackCapture::set_bottom_frames_to_skip(1);
+  StackCapture skipped;
+  skipped.InitFromFramePointers();
+  EXPECT_EQ(capture.num_frames() - 1, skipped.num_frames());
+  std::copy(skipped.frames(), skipped.frames() + skipped.num_frames(), frames);
+  EXPECT_EQ(ComputeStackTraceHash(frames, skipped.num_frames()),
+            skipped.stack_id());
+}
+
+TEST_F(StackCaptureTest, RestrictedFrameCountFromFramePointers) {
+  StackCapture capture(5);
+  capture.InitFromFramePointers();
+  EXPECT_TRUE(capture.IsValid());
+  EXPECT_EQ(5u, capture.num_frames());
+  EXPECT_EQ(5u, capture.max_num_frames());
+}
+
 }  // namespace asan
 }  // namespace agent
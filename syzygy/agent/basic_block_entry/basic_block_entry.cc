@@ -64,6 +64,26 @@
 //      information. A batch commit is done when the buffer is full. In this
 //      mode, under a non-standard execution (crash, force exit, ...) pending
 //      events may be lost.
+//    - Thread-local mode: Enabled by the SYZYGY_BASIC_BLOCK_SNAPSHOT_PERIOD_MS
+//      environment variable, each thread counts into its own counter array
+//      so that hot basic blocks don't bounce a shared cache line between
+//      threads. The thread-local counts are merged into the process-wide
+//      segment as the threads detach, and periodically by a snapshot thread
+//      which writes them to the trace as separate TRACE_INDEXED_FREQUENCY
+//      records. This lets long-running processes report data before they exit.
+//    - Sampled mode: Enabled by the SYZYGY_BASIC_BLOCK_SAMPLING_PERIOD
+//      environment variable, basic block entry counting only records about
+//      one in every N entries. Each thread counts down a randomized interval
+//      with a mean of N, without taking any lock, and credits the block it
+//      lands on with the length of that interval. The counts are estimates,
+//      but are proportional to the actual frequencies, which is all that
+//      layout decisions need.
+//
+//    In basic block entry count mode, the counters may be 1, 2 or 4 bytes
+//    wide, as chosen by the instrumenter. Narrow counters keep the footprint
+//    of hot code low; when one overflows, its count is spilled to a side table
+//    of 32-bit counters which is written to the trace as a separate
+//    TRACE_INDEXED_FREQUENCY record. The grinders sum up these records.
 //
 //    The agent keeps a ThreadState for each running thread. The thread state
 //    is accessible through a TLS mechanism and contains information needed by
@@ -81,10 +101,14 @@
 
 #include "syzygy/agent/basic_block_entry/basic_block_entry.h"
 
+#include <algorithm>
+#include <limits>
+
 #include "base/at_exit.h"
 #include "base/command_line.h"
 #include "base/environment.h"
 #include "base/lazy_instance.h"
+#include "base/string_number_conversions.h"
 #include "base/stringprintf.h"
 #include "base/utf_string_conversions.h"
 #include "base/memory/scoped_ptr.h"
@@ -292,6 +316,116 @@ inline uint32 IncrementAndSaturate(uint32 value) {
   return value;
 }
 
+// Saturation add two 32-bit values.
+inline uint32 AddAndSaturate(uint32 value, uint32 amount) {
+  if (value > ~0U - amount)
+    return ~0U;
+  return value + amount;
+}
+
+// Returns the largest value a counter of @p frequency_size bytes can hold.
+inline uint32 GetCounterMax(uint8 frequency_size) {
+  switch (frequency_size) {
+    case 1:
+      return std::numeric_limits<uint8>::max();
+    case 2:
+      return std::numeric_limits<uint16>::max();
+  }
+  DCHECK_EQ(4U, frequency_size);
+  return std::numeric_limits<uint32>::max();
+}
+
+// Returns the value of the @p frequency_size bytes wide counter at @p index in
+// @p frequency_data.
+inline uint32 GetCounter(const void* frequency_data,
+                         uint8 frequency_size,
+                         size_t index) {
+  switch (frequency_size) {
+    case 1:
+      return static_cast<const uint8*>(frequency_data)[index];
+    case 2:
+      return static_cast<const uint16*>(frequency_data)[index];
+  }
+  DCHECK_EQ(4U, frequency_size);
+  return static_cast<const uint32*>(frequency_data)[index];
+}
+
+// Sets the value of the @p frequency_size bytes wide counter at @p index in
+// @p frequency_data.
+inline void SetCounter(void* frequency_data,
+                       uint8 frequency_size,
+                       size_t index,
+                       uint32 value) {
+  DCHECK_LE(value, GetCounterMax(frequency_size));
+  switch (frequency_size) {
+    case 1:
+      static_cast<uint8*>(frequency_data)[index] = static_cast<uint8>(value);
+      return;
+    case 2:
+      static_cast<uint16*>(frequency_data)[index] = static_cast<uint16>(value);
+      return;
+  }
+  DCHECK_EQ(4U, frequency_size);
+  static_cast<uint32*>(frequency_data)[index] = value;
+}
+
+// Adds @p amount to the @p frequency_size bytes wide counter at @p index in
+// @p frequency_data. What doesn't fit in the counter is spilled to the 32-bit
+// counter at @p index in @p spill_data, if any; otherwise the counter
+// saturates.
+void AddToCounter(void* frequency_data,
+                  uint32* spill_data,
+                  uint8 frequency_size,
+                  size_t index,
+                  uint32 amount) {
+  DCHECK(frequency_data != NULL);
+
+  uint64 total = GetCounter(frequency_data, frequency_size, index);
+  total += amount;
+  uint64 range = static_cast<uint64>(GetCounterMax(frequency_size)) + 1;
+  if (total < range) {
+    SetCounter(frequency_data, frequency_size, index,
+               static_cast<uint32>(total));
+    return;
+  }
+
+  if (spill_data == NULL) {
+    SetCounter(frequency_data, frequency_size, index,
+               GetCounterMax(frequency_size));
+    return;
+  }
+
+  // Keep the remainder in the counter, and spill the rest.
+  SetCounter(frequency_data, frequency_size, index,
+             static_cast<uint32>(total % range));
+  uint64 spilled = total - total % range;
+  spill_data[index] = AddAndSaturate(
+      spill_data[index],
+      static_cast<uint32>(std::min<uint64>(spilled, ~0U)));
+}
+
+// Returns the trace record in which the counters at @p frequency_data live.
+// This is only valid for the counters allocated by the agent in a trace
+// segment.
+TraceIndexedFrequencyData* GetTraceIndexedFrequencyData(void* frequency_data) {
+  DCHECK(frequency_data != NULL);
+  return reinterpret_cast<TraceIndexedFrequencyData*>(
+      reinterpret_cast<uint8*>(frequency_data) -
+          offsetof(TraceIndexedFrequencyData, frequency_data));
+}
+
+// Returns the size of the counters held by @p record, in bytes.
+size_t GetFrequencyDataSize(const TraceIndexedFrequencyData* record) {
+  DCHECK(record != NULL);
+  return record->num_entries * record->num_columns * record->frequency_size;
+}
+
+// Returns the size of @p record, in bytes.
+size_t GetRecordSize(const TraceIndexedFrequencyData* record) {
+  DCHECK(record != NULL);
+  return sizeof(TraceIndexedFrequencyData) + GetFrequencyDataSize(record) - 1;
+}
+
 // Get the address of the module containing @p addr. We do this by querying
 // for the allocation that contains @p addr. This must lie within the
 // instrumented module, and be part of the single allocation in which the
@@ -337,9 +471,11 @@ bool DatatypeVersionIsValid(uint32 data_type,
       return false;
     }
   } else if (data_type == IndexedFrequencyData::BASIC_BLOCK_ENTRY) {
+    // Basic block entry counters may be narrower than an int.
     if (agent_id != ::common::kBasicBlockEntryAgentId ||
         version != ::common::kBasicBlockFrequencyDataVersion ||
-        frequency_size != kIntSize ||
+        (frequency_size != 1 && frequency_size != 2 &&
+         frequency_size != kIntSize) ||
         num_columns != 1U) {
       LOG(ERROR) << "Unexpected values in the basic block data structures.";
       return false;
@@ -390,9 +526,13 @@ class BasicBlockEntry::ThreadState : public agent::common::ThreadStateBase {
   //     application.
   // @param lock Lock associated with the @p frequency_data.
   // @param frequency_data Buffer to commit counters update.
+  // @param spill_data Buffer to which the counts overflowing the counters of
+  //     @p frequency_data are spilled. May be NULL, in which case the counters
+  //     saturate.
   ThreadState(IndexedFrequencyData* module_data,
               base::Lock* lock,
-              void* frequency_data);
+              void* frequency_data,
+              uint32* spill_data);
 
   // Destroy a ThreadState instance.
   ~ThreadState();
@@ -403,11 +543,39 @@ class BasicBlockEntry::ThreadState : public agent::common::ThreadStateBase {
   // Allocate temporary space to simulate a branch predictor.
   void AllocatePredictorCache();
 
+  // Allocate thread-local counters. From then on, this thread counts into them
+  // under a lock of its own rather than into the shared counters.
+  void AllocateLocalFrequencyData();
+
+  // Add the thread-local counts to the shared counters, and reset them. This
+  // may be called from any thread, but only while holding the lock protecting
+  // the shared counters.
+  // @param shared_spill_data The buffer to which the shared counters spill.
+  //     May be NULL.
+  void MergeLocalFrequencyData(uint32* shared_spill_data);
+
+  // Enables sampling. From then on, Sample only lets through about one in
+  // every @p period entries.
+  // @param period the mean number of entries between two samples.
+  void EnableSampling(uint32 period);
+
+  // Counts down to the next sample. This is cheap enough to be called without
+  // holding the trace lock.
+  // @returns the number of entries the current entry stands for: 0 if it
+  //     isn't sampled, and always 1 if sampling isn't enabled.
+  uint32 Sample();
+
   // Saturation increment the frequency record for @p index. Note that in
   // Release mode, no range checking is performed on index.
   // @param basic_block_id the basic block index.
   void Increment(uint32 basic_block_id);
 
+  // Add @p amount to the frequency record for @p index, with the same
+  // overflow handling as Increment.
+  // @param basic_block_id the basic block index.
+  // @param amount the amount to add.
+  void Add(uint32 basic_block_id, uint32 amount);
+
   // Update state and frequency when a jump enters the basic block @p index
   // coming from the basic block @last.
   // @param basic_block_id the basic block index.
@@ -437,6 +605,9 @@ class BasicBlockEntry::ThreadState : public agent::common::ThreadStateBase {
   // Return the lock associated with 'trace_data_' for atomic update.
   base::Lock* trace_lock() { return trace_lock_; }
 
+  // Return the module information this thread state is gathering data on.
+  const IndexedFrequencyData* module_data() const { return module_data_; }
+
   // For a given basic block id, returns the corresponding BBEntryFrequency.
   // @param basic_block_id the basic block index.
   // @returns the bbentry frequency entry for a given basic block id.
@@ -462,6 +633,10 @@ class BasicBlockEntry::ThreadState : public agent::common::ThreadStateBase {
   // allocation of IndexedFrequencyData::frequency_data.
   uint32* frequency_data_;  // Under trace_lock_.
 
+  // The 32-bit counters to which the overflows of narrow counters of
+  // 'frequency_data_' are spilled, or NULL if they saturate.
+  uint32* spill_data_;  // Under trace_lock_.
+
   // Module information this thread state is gathering information on.
   const IndexedFrequencyData* module_data_;
 
@@ -480,18 +655,49 @@ class BasicBlockEntry::ThreadState : public agent::common::ThreadStateBase {
   // The last basic block id executed.
   uint32 last_basic_block_id_;
 
+  // The mean sampling interval, or 0 if sampling is disabled.
+  uint32 sampling_period_;
+
+  // The length of the current sampling interval, and the number of entries
+  // left before its end.
+  uint32 sampling_interval_;
+  uint32 sampling_countdown_;
+
+  // The state of the generator drawing the sampling intervals. This is a
+  // per-thread xorshift generator, so that drawing doesn't need a lock.
+  uint32 sampling_random_state_;
+
+  // The thread-local counters, if any. When allocated, 'frequency_data_'
+  // points to them and 'trace_lock_' points to 'local_lock_'. Their size is
+  // given by module_data_->frequency_size.
+  std::vector<uint8> local_frequency_data_;  // Under local_lock_.
+
+  // The counters to which the thread-local counters spill, if they are
+  // narrower than 32 bits. When allocated, 'spill_data_' points to them.
+  std::vector<uint32> local_spill_data_;  // Under local_lock_.
+
+  // The lock protecting the thread-local counters. It's only contended when
+  // the counters get merged into the shared ones.
+  base::Lock local_lock_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(ThreadState);
 };
 
 BasicBlockEntry::ThreadState::ThreadState(IndexedFrequencyData* module_data,
                                           base::Lock* lock,
-                                          void* frequency_data)
+                                          void* frequency_data,
+                                          uint32* spill_data)
     : frequency_data_(static_cast<uint32*>(frequency_data)),
+      spill_data_(spill_data),
       module_data_(module_data),
       trace_lock_(lock),
       basic_block_id_buffer_offset_(0),
-      last_basic_block_id_(kInvalidBasicBlockId) {
+      last_basic_block_id_(kInvalidBasicBlockId),
+      sampling_period_(0),
+      sampling_interval_(0),
+      sampling_countdown_(0),
+      sampling_random_state_(0) {
 }
 
 BasicBlockEntry::ThreadState::~ThreadState() {
@@ -515,6 +721,87 @@ void BasicBlockEntry::ThreadState::AllocatePredictorCache() {
   predictor_data_.resize(kPredictorCacheSize);
 }
 
+void BasicBlockEntry::ThreadState::AllocateLocalFrequencyData() {
+  DCHECK(local_frequency_data_.empty());
+  DCHECK(module_data_ != NULL);
+  size_t num_counters = module_data_->num_entries * module_data_->num_columns;
+  local_frequency_data_.resize(num_counters * module_data_->frequency_size);
+  frequency_data_ = reinterpret_cast<uint32*>(&local_frequency_data_[0]);
+  if (module_data_->frequency_size != sizeof(uint32)) {
+    local_spill_data_.resize(num_counters);
+    spill_data_ = &local_spill_data_[0];
+  }
+  trace_lock_ = &local_lock_;
+}
+
+void BasicBlockEntry::ThreadState::MergeLocalFrequencyData(
+    uint32* shared_spill_data) {
+  DCHECK(module_data_ != NULL);
+  DCHECK(module_data_->frequency_data != NULL);
+
+  uint8 frequency_size = module_data_->frequency_size;
+  size_t num_counters = module_data_->num_entries * module_data_->num_columns;
+
+  base::AutoLock scoped_lock(local_lock_);
+  DCHECK_EQ(num_counters * frequency_size, local_frequency_data_.size());
+  for (size_t i = 0; i < num_counters; ++i) {
+    uint32 amount = GetCounter(&local_frequency_data_[0], frequency_size, i);
+    if (amount != 0) {
+      AddToCounter(module_data_->frequency_data, shared_spill_data,
+                   frequency_size, i, amount);
+      SetCounter(&local_frequency_data_[0], frequency_size, i, 0);
+    }
+
+    if (local_spill_data_.empty() || local_spill_data_[i] == 0)
+      continue;
+    if (shared_spill_data != NULL) {
+      shared_spill_data[i] =
+          AddAndSaturate(shared_spill_data[i], local_spill_data_[i]);
+    } else {
+      SetCounter(module_data_->frequency_data, frequency_size, i,
+                 GetCounterMax(frequency_size));
+    }
+    local_spill_data_[i] = 0;
+  }
+}
+
+void BasicBlockEntry::ThreadState::EnableSampling(uint32 period) {
+  DCHECK_LT(1U, period);
+  DCHECK_EQ(0U, sampling_period_);
+
+  // Seed the generator differently in each thread. It must never be zero.
+  sampling_period_ = period;
+  sampling_random_state_ = ::GetCurrentThreadId() ^ ::GetTickCount();
+  if (sampling_random_state_ == 0)
+    sampling_random_state_ = 1;
+
+  // Draw the first interval.
+  sampling_countdown_ = 1;
+  sampling_interval_ = 0;
+  Sample();
+}
+
+inline uint32 BasicBlockEntry::ThreadState::Sample() {
+  if (sampling_period_ == 0)
+    return 1;
+
+  DCHECK_NE(0U, sampling_countdown_);
+  if (--sampling_countdown_ != 0)
+    return 0;
+
+  // Draw the next interval uniformly in [1, 2 * period - 1], so that its mean
+  // is the period. Randomizing it keeps the samples from locking step with
+  // the loops of the instrumented code.
+  sampling_random_state_ ^= sampling_random_state_ << 13;
+  sampling_random_state_ ^= sampling_random_state_ >> 17;
+  sampling_random_state_ ^= sampling_random_state_ << 5;
+  uint32 weight = sampling_interval_;
+  sampling_interval_ =
+      1 + sampling_random_state_ % (2 * sampling_period_ - 1);
+  sampling_countdown_ = sampling_interval_;
+  return weight;
+}
+
 void BasicBlockEntry::ThreadState::reset_last_basic_block_id() {
   last_basic_block_id_ = kInvalidBasicBlockId;
 }
@@ -542,11 +829,49 @@ inline void BasicBlockEntry::ThreadState::Increment(uint32 basic_block_id) {
   DCHECK(module_data_ != NULL);
   DCHECK_LT(basic_block_id, module_data_->num_entries);
 
+  // Narrow counters spill once they overflow.
+  switch (module_data_->frequency_size) {
+    case 1: {
+      uint8& counter =
+          reinterpret_cast<uint8*>(frequency_data_)[basic_block_id];
+      if (counter != std::numeric_limits<uint8>::max()) {
+        ++counter;
+        return;
+      }
+      AddToCounter(frequency_data_, spill_data_, 1, basic_block_id, 1);
+      return;
+    }
+    case 2: {
+      uint16& counter =
+          reinterpret_cast<uint16*>(frequency_data_)[basic_block_id];
+      if (counter != std::numeric_limits<uint16>::max()) {
+        ++counter;
+        return;
+      }
+      AddToCounter(frequency_data_, spill_data_, 2, basic_block_id, 1);
+      return;
+    }
+  }
+
   // Retrieve information for the basic block.
   BBEntryFrequency& entry = GetBBEntryFrequency(basic_block_id);
   entry.frequency = IncrementAndSaturate(entry.frequency);
 }
 
+void BasicBlockEntry::ThreadState::Add(uint32 basic_block_id, uint32 amount) {
+  DCHECK(frequency_data_ != NULL);
+  DCHECK(module_data_ != NULL);
+  DCHECK_LT(basic_block_id, module_data_->num_entries);
+
+  if (amount == 1) {
+    Increment(basic_block_id);
+    return;
+  }
+
+  AddToCounter(frequency_data_, spill_data_, module_data_->frequency_size,
+               basic_block_id, amount);
+}
+
 void BasicBlockEntry::ThreadState::Enter(
     uint32 basic_block_id, uint32 last_basic_block_id) {
   DCHECK(frequency_data_ != NULL);
@@ -640,7 +965,41 @@ BasicBlockEntry* BasicBlockEntry::Instance() {
   return static_bbentry_instance.Pointer();
 }
 
-BasicBlockEntry::BasicBlockEntry() : registered_slots_() {
+const char BasicBlockEntry::kSnapshotPeriodEnvVar[] =
+    "SYZYGY_BASIC_BLOCK_SNAPSHOT_PERIOD_MS";
+const char BasicBlockEntry::kSamplingPeriodEnvVar[] =
+    "SYZYGY_BASIC_BLOCK_SAMPLING_PERIOD";
+
+BasicBlockEntry::BasicBlockEntry()
+    : registered_slots_(),
+      use_local_counters_(false),
+      snapshot_period_ms_(0),
+      sampling_period_(0) {
+  // Check whether the thread-local counters are requested.
+  scoped_ptr<base::Environment> env(base::Environment::Create());
+  std::string period_str;
+  if (env->GetVar(kSnapshotPeriodEnvVar, &period_str)) {
+    if (base::StringToSizeT(period_str, &snapshot_period_ms_)) {
+      use_local_counters_ = true;
+    } else {
+      LOG(ERROR) << "Invalid value for " << kSnapshotPeriodEnvVar << ": \""
+                 << period_str << "\".";
+    }
+  }
+
+  // Check whether sampled counting is requested.
+  std::string sampling_str;
+  if (env->GetVar(kSamplingPeriodEnvVar, &sampling_str)) {
+    size_t sampling_period = 0;
+    if (base::StringToSizeT(sampling_str, &sampling_period) &&
+        sampling_period <= std::numeric_limits<uint32>::max() / 2) {
+      sampling_period_ = static_cast<uint32>(sampling_period);
+    } else {
+      LOG(ERROR) << "Invalid value for " << kSamplingPeriodEnvVar << ": \""
+                 << sampling_str << "\".";
+    }
+  }
+
   // Create a session.
   trace::client::InitializeRpcSession(&session_, &segment_);
 }
@@ -667,9 +1026,20 @@ bool BasicBlockEntry::InitializeFrequencyData(IndexedFrequencyData* data) {
   // Determine the size of the basic block frequency record.
   size_t record_size = sizeof(TraceIndexedFrequencyData) + data_size - 1;
 
+  // Narrow counters get a side table of 32-bit counters to spill to, which is
+  // recorded right after them.
+  bool needs_spill_data = data->frequency_size != sizeof(uint32);
+  size_t spill_data_size = data->num_entries * data->num_columns *
+      sizeof(uint32);
+  size_t spill_record_size =
+      sizeof(TraceIndexedFrequencyData) + spill_data_size - 1;
+
   // Determine the size of the buffer we need. We need room for the basic block
-  // frequency struct plus a single RecordPrefix header.
+  // frequency struct plus a single RecordPrefix header, and as much for the
+  // spill table if any.
   size_t segment_size = sizeof(RecordPrefix) + record_size;
+  if (needs_spill_data)
+    segment_size += sizeof(RecordPrefix) + spill_record_size;
 
   // Allocate the actual segment for the frequency data.
   if (!session_.AllocateBuffer(segment_size, &segment_)) {
@@ -710,9 +1080,59 @@ bool BasicBlockEntry::InitializeFrequencyData(IndexedFrequencyData* data) {
   data->frequency_data =
       reinterpret_cast<uint32*>(&trace_data->frequency_data[0]);
 
+  if (!needs_spill_data)
+    return true;
+
+  // Allocate the spill table. It describes the same module, with 32-bit
+  // counters.
+  DCHECK(segment_.CanAllocate(spill_record_size));
+  TraceIndexedFrequencyData* spill_trace_data =
+      reinterpret_cast<TraceIndexedFrequencyData*>(
+          segment_.AllocateTraceRecordImpl(TRACE_INDEXED_FREQUENCY,
+                                           spill_record_size));
+  DCHECK(spill_trace_data != NULL);
+  ::memcpy(spill_trace_data, trace_data, sizeof(TraceIndexedFrequencyData));
+  spill_trace_data->frequency_size = sizeof(uint32);
+
+  base::AutoLock scoped_lock(lock_);
+  spill_data_map_[data] =
+      reinterpret_cast<uint32*>(&spill_trace_data->frequency_data[0]);
+
+  return true;
+}
+
+bool BasicBlockEntry::InitializeLiveFrequencyData(IndexedFrequencyData* data) {
+  DCHECK(data != NULL);
+
+  if (data->num_entries == 0)
+    return false;
+
+  HMODULE module = GetModuleForAddr(data);
+  CHECK(module != NULL);
+  ::common::LiveFrequencyData* live_data =
+      agent::common::CreateLiveFrequencyData(module, *data);
+  if (live_data == NULL)
+    return false;
+
+  base::AutoLock scoped_lock(lock_);
+  live_data_.push_back(live_data);
+  live_modules_.insert(data);
+  data->frequency_data = live_data->frequency_data();
+
   return true;
 }
 
+uint32* BasicBlockEntry::GetSpillDataUnlocked(
+    const IndexedFrequencyData* module_data) {
+  DCHECK(module_data != NULL);
+  lock_.AssertAcquired();
+
+  SpillDataMap::const_iterator it = spill_data_map_.find(module_data);
+  if (it == spill_data_map_.end())
+    return NULL;
+  return it->second;
+}
+
 BasicBlockEntry::ThreadState* BasicBlockEntry::CreateThreadState(
     IndexedFrequencyData* module_data) {
   DCHECK(module_data != NULL);
@@ -722,10 +1142,19 @@ BasicBlockEntry::ThreadState* BasicBlockEntry::CreateThreadState(
   BasicBlockIndexedFrequencyData* basicblock_data =
       reinterpret_cast<BasicBlockIndexedFrequencyData*>(module_data);
 
+  // Get the spill table of the counters, if any, and whether they're live.
+  uint32* spill_data = NULL;
+  bool is_live = false;
+  {
+    base::AutoLock scoped_lock(lock_);
+    spill_data = GetSpillDataUnlocked(module_data);
+    is_live = live_modules_.count(module_data) != 0;
+  }
+
   // Create the thread-local state for this thread. By default, just point the
   // counter array to the statically allocated fall-back area.
-  ThreadState* state =
-    new ThreadState(module_data, &lock_, module_data->frequency_data);
+  ThreadState* state = new ThreadState(
+      module_data, &lock_, module_data->frequency_data, spill_data);
   CHECK(state != NULL);
 
   // Register the thread state with the thread state manager.
@@ -762,6 +1191,23 @@ BasicBlockEntry::ThreadState* BasicBlockEntry::CreateThreadState(
   // Allocate buffer to which basic block id are pushed before being committed.
   state->AllocateBasicBlockIdBuffer();
 
+  // Only basic block entry counts get sampled. Branch profiling needs to see
+  // consecutive entries.
+  if (sampling_period_ > 1 &&
+      module_data->data_type ==
+          ::common::IndexedFrequencyData::BASIC_BLOCK_ENTRY) {
+    state->EnableSampling(sampling_period_);
+  }
+
+  // Count into thread-local counters if requested. These only get merged into
+  // the shared ones when the thread detaches or a snapshot gets taken. Live
+  // counts must be visible as they happen, so they don't use these.
+  if (use_local_counters_ && !is_live) {
+    state->AllocateLocalFrequencyData();
+    base::AutoLock scoped_lock(lock_);
+    local_counter_states_.insert(state);
+  }
+
   return state;
 }
 
@@ -800,8 +1246,13 @@ void WINAPI BasicBlockEntry::IncrementIndexedFreqDataHook(
     state = Instance()->CreateThreadState(entry_frame->module_data);
   }
 
+  // Skip the entries that aren't sampled before taking the lock.
+  uint32 amount = state->Sample();
+  if (amount == 0)
+    return;
+
   base::AutoLock scoped_lock(*state->trace_lock());
-  state->Increment(entry_frame->index);
+  state->Add(entry_frame->index, amount);
 }
 
 void WINAPI BasicBlockEntry::BranchEnterHook(
@@ -925,6 +1376,10 @@ void WINAPI BasicBlockEntry::DllMainEntryHook(DllMainEntryFrame* entry_frame) {
       break;
 
     case DLL_PROCESS_DETACH:
+      Instance()->OnThreadDetach(entry_frame->module_data);
+      Instance()->OnProcessDetach(entry_frame->module_data);
+      break;
+
     case DLL_THREAD_DETACH:
       Instance()->OnThreadDetach(entry_frame->module_data);
       break;
@@ -1014,6 +1469,13 @@ void BasicBlockEntry::OnProcessAttach(IndexedFrequencyData* module_data) {
   if (basicblock_data->fs_slot != 0)
     RegisterFastPathSlot(module_data, basicblock_data->fs_slot);
 
+  // Expose the counts through shared memory if requested. This doesn't
+  // require a call trace service.
+  if (InitializeLiveFrequencyData(module_data)) {
+    LOG(INFO) << "BBEntry client initialized with live frequency data.";
+    return;
+  }
+
   // Register this module with the call_trace if the session is not disabled.
   // Note that we expect module_data to be statically defined within the
   // module of interest, so we can use its address to lookup the module.
@@ -1029,6 +1491,13 @@ void BasicBlockEntry::OnProcessAttach(IndexedFrequencyData* module_data) {
 
   RegisterModule(module_data);
 
+  if (use_local_counters_) {
+    base::AutoLock scoped_lock(lock_);
+    snapshot_modules_.push_back(module_data);
+    if (snapshot_period_ms_ != 0)
+      StartSnapshotThread();
+  }
+
   LOG(INFO) << "BBEntry client initialized.";
 }
 
@@ -1046,9 +1515,147 @@ void BasicBlockEntry::OnThreadDetach(IndexedFrequencyData* module_data) {
   if (state == NULL)
     return;
 
-  state->Flush();
+  {
+    base::AutoLock scoped_lock(*state->trace_lock());
+    state->Flush();
+  }
+
+  if (use_local_counters_) {
+    base::AutoLock scoped_lock(lock_);
+    if (local_counter_states_.erase(state) != 0)
+      state->MergeLocalFrequencyData(GetSpillDataUnlocked(module_data));
+  }
+
   thread_state_manager_.MarkForDeath(state);
 }
 
+void BasicBlockEntry::OnProcessDetach(IndexedFrequencyData* module_data) {
+  DCHECK(module_data != NULL);
+
+  if (!use_local_counters_)
+    return;
+
+  base::AutoLock scoped_lock(lock_);
+
+  // Merge the counts of the threads still running in this module, and forget
+  // about them as the module is going away.
+  std::set<ThreadState*>::iterator it = local_counter_states_.begin();
+  while (it != local_counter_states_.end()) {
+    if ((*it)->module_data() != module_data) {
+      ++it;
+      continue;
+    }
+    (*it)->MergeLocalFrequencyData(GetSpillDataUnlocked(module_data));
+    local_counter_states_.erase(it++);
+  }
+
+  // The remaining counts get written to the trace with the shared counters as
+  // the client gets torn down.
+  std::vector<IndexedFrequencyData*>::iterator module_it =
+      std::find(snapshot_modules_.begin(), snapshot_modules_.end(),
+                module_data);
+  if (module_it != snapshot_modules_.end())
+    snapshot_modules_.erase(module_it);
+}
+
+void BasicBlockEntry::MergeLocalFrequencyDataUnlocked() {
+  lock_.AssertAcquired();
+
+  std::set<ThreadState*>::iterator it = local_counter_states_.begin();
+  for (; it != local_counter_states_.end(); ++it)
+    (*it)->MergeLocalFrequencyData(GetSpillDataUnlocked((*it)->module_data()));
+}
+
+bool BasicBlockEntry::WriteSnapshotUnlocked(IndexedFrequencyData* module_data) {
+  DCHECK(module_data != NULL);
+  lock_.AssertAcquired();
+
+  // The snapshot is a copy of the records holding the shared counters and
+  // their spill table, if any.
+  TraceIndexedFrequencyData* records[2] = {
+      GetTraceIndexedFrequencyData(module_data->frequency_data), NULL };
+  size_t num_records = 1;
+  uint32* spill_data = GetSpillDataUnlocked(module_data);
+  if (spill_data != NULL)
+    records[num_records++] = GetTraceIndexedFrequencyData(spill_data);
+
+  size_t segment_size = 0;
+  for (size_t i = 0; i < num_records; ++i)
+    segment_size += sizeof(RecordPrefix) + GetRecordSize(records[i]);
+
+  TraceFileSegment snapshot_segment;
+  if (!session_.AllocateBuffer(segment_size, &snapshot_segment)) {
+    LOG(ERROR) << "Failed to allocate snapshot segment.";
+    return false;
+  }
+
+  for (size_t i = 0; i < num_records; ++i) {
+    size_t record_size = GetRecordSize(records[i]);
+    if (!snapshot_segment.CanAllocate(record_size)) {
+      LOG(ERROR) << "Returned snapshot segment smaller than expected.";
+      return false;
+    }
+
+    void* snapshot = snapshot_segment.AllocateTraceRecordImpl(
+        TRACE_INDEXED_FREQUENCY, record_size);
+    DCHECK(snapshot != NULL);
+    ::memcpy(snapshot, records[i], record_size);
+
+    // The counts are now in the trace, so they start over. The grinders sum
+    // up the records of a given module.
+    ::memset(records[i]->frequency_data, 0, GetFrequencyDataSize(records[i]));
+  }
+
+  if (!session_.ReturnBuffer(&snapshot_segment)) {
+    LOG(ERROR) << "Failed to return snapshot segment.";
+    return false;
+  }
+
+  return true;
+}
+
+void BasicBlockEntry::StartSnapshotThread() {
+  DCHECK_NE(0U, snapshot_period_ms_);
+  lock_.AssertAcquired();
+
+  if (snapshot_thread_.IsValid())
+    return;
+
+  // This is called under the loader lock, which the new thread won't need
+  // until it starts running.
+  snapshot_thread_.Set(
+      ::CreateThread(NULL, 0, &SnapshotThreadMain, this, 0, NULL));
+  if (!snapshot_thread_.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to start the snapshot thread: "
+               << com::LogWe(error) << ".";
+  }
+}
+
+DWORD WINAPI BasicBlockEntry::SnapshotThreadMain(void* param) {
+  DCHECK(param != NULL);
+  BasicBlockEntry* self = reinterpret_cast<BasicBlockEntry*>(param);
+
+  while (true) {
+    ::Sleep(self->snapshot_period_ms_);
+
+    base::AutoLock scoped_lock(self->lock_);
+
+    // We can't be joined from DllMain without deadlocking on the loader lock,
+    // so we exit on our own once all the modules have detached. Another
+    // thread gets started if an instrumented module gets loaded afterwards.
+    if (self->snapshot_modules_.empty()) {
+      self->snapshot_thread_.Close();
+      return 0;
+    }
+
+    self->MergeLocalFrequencyDataUnlocked();
+    for (size_t i = 0; i < self->snapshot_modules_.size(); ++i) {
+      if (!self->WriteSnapshotUnlocked(self->snapshot_modules_[i]))
+        LOG(ERROR) << "Failed to write frequency data snapshot.";
+    }
+  }
+}
+
 }  // namespace basic_block_entry
 }  // namespace agent
@@ -26,12 +26,17 @@
 
 #include <windows.h>
 #include <winnt.h>
+#include <map>
+#include <set>
 #include <vector>
 
 #include "base/lazy_instance.h"
+#include "base/memory/scoped_vector.h"
 #include "base/win/pe_image.h"
+#include "base/win/scoped_handle.h"
 #include "syzygy/agent/common/thread_state.h"
 #include "syzygy/common/indexed_frequency_data.h"
+#include "syzygy/common/live_frequency_data.h"
 #include "syzygy/trace/client/rpc_session.h"
 
 namespace agent {
@@ -55,6 +60,18 @@ class BasicBlockEntry {
   // The number of entries in the simulated branch predictor cache.
   static const size_t kPredictorCacheSize = 4096;
 
+  // The name of the environment variable enabling the thread-local counters.
+  // Its value is the period, in milliseconds, at which the counts are written
+  // to the trace. With a period of zero, the counts are only written as the
+  // threads and the modules detach.
+  static const char kSnapshotPeriodEnvVar[];
+
+  // The name of the environment variable enabling sampled basic block entry
+  // counting. Its value is the mean number of entries between two samples.
+  // Each sample counts for the number of entries since the previous one, so
+  // the counts remain proportional to the actual frequencies.
+  static const char kSamplingPeriodEnvVar[];
+
   // This structure describes the contents of the stack above a call to
   // BasicBlockEntry::IncrementIndexedFreqDataHook. A pointer to this structure
   // will be given to the IncrementIndexedFreqDataHook by
@@ -125,9 +142,25 @@ class BasicBlockEntry {
   BasicBlockEntry();
   ~BasicBlockEntry();
 
+  // A map from a module's frequency data to the side table its narrow
+  // counters spill to.
+  typedef std::map<const IndexedFrequencyData*, uint32*> SpillDataMap;
+
   // Initializes the given frequency data element.
   bool InitializeFrequencyData(IndexedFrequencyData* data);
 
+  // Points the given frequency data element to a live frequency data section,
+  // if these are requested. Live counts aren't written to the trace, and are
+  // always counted directly in the shared counters. Narrow counters saturate,
+  // as they don't get a spill table.
+  // @returns true if the data element now refers to a live section, false
+  //     otherwise.
+  bool InitializeLiveFrequencyData(IndexedFrequencyData* data);
+
+  // Returns the side table to which the counters of @p module_data spill, or
+  // NULL if they don't. This must be called under lock_.
+  uint32* GetSpillDataUnlocked(const IndexedFrequencyData* module_data);
+
   // Handles EXE startup on ExeMainEntryHook and DLL_PROCESS_ATTACH messages
   // received by DllMainEntryHook().
   void OnProcessAttach(IndexedFrequencyData* module_data);
@@ -136,6 +169,9 @@ class BasicBlockEntry {
   // DllMainEntryHook().
   void OnThreadDetach(IndexedFrequencyData* module_data);
 
+  // Handles DLL_PROCESS_DETACH messages received by DllMainEntryHook().
+  void OnProcessDetach(IndexedFrequencyData* module_data);
+
   // Registers the module containing @p addr with the call_trace_service.
   void RegisterModule(const void* addr);
 
@@ -160,9 +196,58 @@ class BasicBlockEntry {
   template<int S>
   static ThreadState* GetThreadStateSlot();
 
+  // @name Thread-local counters management.
+  // @{
+  // Adds the counts accumulated in the thread-local counters to the shared
+  // ones. This must be called under lock_.
+  void MergeLocalFrequencyDataUnlocked();
+
+  // Writes the counts accumulated in the shared counters of @p module_data
+  // to the trace, and resets them. This must be called under lock_.
+  // @returns true on success, false otherwise.
+  bool WriteSnapshotUnlocked(IndexedFrequencyData* module_data);
+
+  // Starts the thread periodically writing the counts to the trace.
+  void StartSnapshotThread();
+
+  // The entry point of the snapshot thread.
+  // @param param The BasicBlockEntry instance.
+  static DWORD WINAPI SnapshotThreadMain(void* param);
+  // @}
+
   // Registered thread local specific slot.
   uint32 registered_slots_;
 
+  // If true, each thread counts into its own counters, which are merged into
+  // the shared ones as the threads detach and by the snapshot thread.
+  bool use_local_counters_;
+
+  // The period at which the snapshot thread writes the counts to the trace,
+  // in milliseconds. The snapshot thread isn't started if this is zero.
+  size_t snapshot_period_ms_;
+
+  // The mean number of basic block entries between two counted ones. Every
+  // entry is counted if this is 0 or 1.
+  uint32 sampling_period_;
+
+  // The snapshot thread, if it's running.
+  base::win::ScopedHandle snapshot_thread_;
+
+  // The thread states counting into thread-local counters.
+  std::set<ThreadState*> local_counter_states_;  // Under lock_.
+
+  // The modules whose counts are written to the trace by the snapshot thread.
+  std::vector<IndexedFrequencyData*> snapshot_modules_;  // Under lock_.
+
+  // The side tables of the modules with narrow counters. These live in the
+  // same trace segments as the counters.
+  SpillDataMap spill_data_map_;  // Under lock_.
+
+  // The modules whose counts are exposed through live frequency data
+  // sections, and these sections.
+  std::set<const IndexedFrequencyData*> live_modules_;  // Under lock_.
+  ScopedVector< ::common::LiveFrequencyData> live_data_;  // Under lock_.
+
   // The RPC session we're logging to/through.
   trace::client::RpcSession session_;
 
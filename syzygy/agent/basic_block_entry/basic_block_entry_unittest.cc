@@ -18,13 +18,17 @@
 
 #include "base/bind.h"
 #include "base/callback.h"
+#include "base/environment.h"
 #include "base/file_util.h"
+#include "base/string_number_conversions.h"
 #include "base/stringprintf.h"
 #include "base/files/scoped_temp_dir.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/threading/thread.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/common/indexed_frequency_data.h"
+#include "syzygy/common/live_frequency_data.h"
 #include "syzygy/trace/common/unittest_util.h"
 #include "syzygy/trace/parse/unittest_util.h"
 
@@ -46,6 +50,14 @@ using trace::parser::Parser;
 // This is the name of the agent DLL.
 const wchar_t kBasicBlockEntryClientDll[] = L"basic_block_entry_client.dll";
 
+// The environment variable enabling the agent's thread-local counters. This
+// mirrors BasicBlockEntry::kSnapshotPeriodEnvVar, which lives in the agent DLL.
+const char kSnapshotPeriodEnvVar[] = "SYZYGY_BASIC_BLOCK_SNAPSHOT_PERIOD_MS";
+
+// The environment variable enabling the agent's sampled counting. This mirrors
+// BasicBlockEntry::kSamplingPeriodEnvVar.
+const char kSamplingPeriodEnvVar[] = "SYZYGY_BASIC_BLOCK_SAMPLING_PERIOD";
+
 // The number of columns we'll work with for these tests.
 const uint32 kNumColumns = 1;
 const uint32 kNumBranchColumns = 3;
@@ -115,6 +127,14 @@ class BasicBlockEntryTest : public testing::Test {
     ::memset(&default_frequency_data_, 0, sizeof(default_frequency_data_));
   }
 
+  void ConfigureNarrowBasicBlockAgent() {
+    ConfigureBasicBlockAgent();
+    common_data_->frequency_size = sizeof(default_narrow_frequency_data_[0]);
+    common_data_->frequency_data = default_narrow_frequency_data_;
+    ::memset(&default_narrow_frequency_data_, 0,
+             sizeof(default_narrow_frequency_data_));
+  }
+
   void ConfigureBranchAgent() {
     common_data_->agent_id = ::common::kBasicBlockEntryAgentId;
     common_data_->data_type = ::common::IndexedFrequencyData::BRANCH;
@@ -529,6 +549,7 @@ class BasicBlockEntryTest : public testing::Test {
   // This will be a stand-in for the (usually statically allocated) fall-back
   // frequency to which module_data_.frequency_data will point.
   static uint32 default_frequency_data_[kNumBasicBlocks];
+  static uint8 default_narrow_frequency_data_[kNumBasicBlocks];
   static uint32 default_branch_data_[kNumBranchColumns * kNumBasicBlocks];
 
   // The basic-block entry entrance hook.
@@ -592,6 +613,7 @@ BasicBlockEntry::BasicBlockIndexedFrequencyData
     BasicBlockEntryTest::module_data_ = {};
 BasicBlockEntry::IndexedFrequencyData* BasicBlockEntryTest::common_data_ = NULL;
 uint32 BasicBlockEntryTest::default_frequency_data_[] = {};
+uint8 BasicBlockEntryTest::default_narrow_frequency_data_[] = {};
 uint32 BasicBlockEntryTest::default_branch_data_[] = {};
 FARPROC BasicBlockEntryTest::basic_block_enter_stub_ = NULL;
 FARPROC BasicBlockEntryTest::basic_block_enter_buffered_stub_ = NULL;
@@ -660,6 +682,96 @@ TEST_F(BasicBlockEntryTest, NoServerNoCrash) {
   ASSERT_NO_FATAL_FAILURE(ReplayLogs(0));
 }
 
+TEST_F(BasicBlockEntryTest, NoServerNarrowCountersSaturate) {
+  // Configure for BasicBlock mode with 8-bit counters.
+  ConfigureNarrowBasicBlockAgent();
+
+  // Load the agent dll.
+  ASSERT_NO_FATAL_FAILURE(LoadDll());
+
+  // Simulate the process attach event.
+  SimulateModuleEvent(DLL_PROCESS_ATTACH);
+  ASSERT_EQ(1U, common_data_->frequency_size);
+  ASSERT_EQ(default_narrow_frequency_data_, common_data_->frequency_data);
+
+  // Without a trace there's nowhere to spill to, so the counters saturate.
+  for (size_t i = 0; i < 300; ++i)
+    SimulateBasicBlockEntry(0);
+  SimulateBasicBlockEntry(1);
+  ASSERT_EQ(0xFFU, default_narrow_frequency_data_[0]);
+  ASSERT_EQ(1U, default_narrow_frequency_data_[1]);
+
+  // Simulate the process detach event.
+  SimulateModuleEvent(DLL_PROCESS_DETACH);
+
+  // Unload the DLL.
+  ASSERT_NO_FATAL_FAILURE(UnloadDll());
+
+  // Replay the log. There should be none as we didn't start the service.
+  ASSERT_NO_FATAL_FAILURE(ReplayLogs(0));
+}
+
+TEST_F(BasicBlockEntryTest, NoServerLiveFrequencyData) {
+  // Configure for BasicBlock mode.
+  ConfigureBasicBlockAgent();
+
+  scoped_ptr<base::Environment> env(base::Environment::Create());
+  ASSERT_TRUE(env.get() != NULL);
+  ASSERT_TRUE(env->SetVar(::common::kLiveFrequencyDataEnvVar,
+                          "BasicBlockEntryTest"));
+
+  // Load the agent dll.
+  ASSERT_NO_FATAL_FAILURE(LoadDll());
+
+  // Simulate the process attach event.
+  SimulateModuleEvent(DLL_PROCESS_ATTACH);
+  ASSERT_TRUE(env->UnSetVar(::common::kLiveFrequencyDataEnvVar));
+
+  // The counters should have moved to a live section named after this module,
+  // even though there is no call trace service.
+  ASSERT_NE(default_frequency_data_, common_data_->frequency_data);
+  wchar_t module_path[MAX_PATH] = { 0 };
+  ASSERT_NE(0U, ::GetModuleFileName(reinterpret_cast<HMODULE>(&__ImageBase),
+                                    module_path, arraysize(module_path)));
+  ::common::LiveFrequencyData reader;
+  ASSERT_TRUE(reader.Open(::common::GetLiveFrequencyDataName(
+      L"BasicBlockEntryTest", ::GetCurrentProcessId(),
+      base::FilePath(module_path).BaseName().value())));
+  ASSERT_EQ(kNumBasicBlocks, reader.header()->num_entries);
+
+  // The counts can be read and reset while the process is running.
+  SimulateBasicBlockEntry(0);
+  SimulateBasicBlockEntry(0);
+  SimulateBasicBlockEntry(1);
+
+  std::vector<uint8> data;
+  uint32 epoch = 0;
+  reader.Snapshot(&data, &epoch);
+  EXPECT_EQ(0U, epoch);
+  ASSERT_EQ(sizeof(default_frequency_data_), data.size());
+  const uint32* counts = reinterpret_cast<const uint32*>(&data[0]);
+  EXPECT_EQ(2U, counts[0]);
+  EXPECT_EQ(1U, counts[1]);
+
+  reader.Reset();
+  SimulateBasicBlockEntry(1);
+
+  reader.Snapshot(&data, &epoch);
+  EXPECT_EQ(1U, epoch);
+  counts = reinterpret_cast<const uint32*>(&data[0]);
+  EXPECT_EQ(0U, counts[0]);
+  EXPECT_EQ(1U, counts[1]);
+
+  // Simulate the process detach event.
+  SimulateModuleEvent(DLL_PROCESS_DETACH);
+
+  // Unload the DLL.
+  ASSERT_NO_FATAL_FAILURE(UnloadDll());
+
+  // Replay the log. There should be none as we didn't start the service.
+  ASSERT_NO_FATAL_FAILURE(ReplayLogs(0));
+}
+
 TEST_F(BasicBlockEntryTest, SingleThreadedDllBasicBlockEvents) {
   // Configure for BasicBlock mode.
   ConfigureBasicBlockAgent();
@@ -721,6 +833,121 @@ TEST_F(BasicBlockEntryTest, SingleThreadedDllBasicBlockEvents) {
   ASSERT_NO_FATAL_FAILURE(ReplayLogs(1));
 }
 
+TEST_F(BasicBlockEntryTest, SingleThreadedDllLocalCountersEvents) {
+  // Request the thread-local counters, without periodic snapshots. This must
+  // be set before the agent gets loaded.
+  scoped_ptr<base::Environment> env(base::Environment::Create());
+  ASSERT_TRUE(env->SetVar(kSnapshotPeriodEnvVar, "0"));
+
+  // Configure for BasicBlock mode.
+  ConfigureBasicBlockAgent();
+
+  ASSERT_NO_FATAL_FAILURE(StartService());
+  ASSERT_NO_FATAL_FAILURE(LoadDll());
+
+  // Simulate the process attach event.
+  SimulateModuleEvent(DLL_PROCESS_ATTACH);
+
+  // The frequency_data must be allocated and frequency_data must point to it.
+  ASSERT_NE(default_branch_data_, common_data_->frequency_data);
+  const uint32* frequency_data =
+      static_cast<const uint32*>(common_data_->frequency_data);
+
+  // The counts go to the thread-local counters, not to the shared ones.
+  SimulateBasicBlockEntry(0);
+  SimulateBasicBlockEntry(0);
+  SimulateBasicBlockEntry(1);
+  SimulateBasicBlockEntry(0);
+  ASSERT_EQ(0U, frequency_data[0]);
+  ASSERT_EQ(0U, frequency_data[1]);
+
+  // Simulate the process detach event. This merges the thread-local counts.
+  SimulateModuleEvent(DLL_PROCESS_DETACH);
+  ASSERT_EQ(3U, frequency_data[0]);
+  ASSERT_EQ(1U, frequency_data[1]);
+
+  // Unload the DLL and stop the service.
+  ASSERT_NO_FATAL_FAILURE(UnloadDll());
+  ASSERT_TRUE(env->UnSetVar(kSnapshotPeriodEnvVar));
+
+  HMODULE self = ::GetModuleHandle(NULL);
+  DWORD process_id = ::GetCurrentProcessId();
+  DWORD thread_id = ::GetCurrentThreadId();
+
+  static const uint32 kExpectedFrequencyData[kNumBasicBlocks] = { 3, 1 };
+
+  // Set up expectations for what should be in the trace.
+  EXPECT_CALL(handler_, OnProcessStarted(_, process_id, _));
+  EXPECT_CALL(handler_, OnProcessAttach(_,
+                                        process_id,
+                                        thread_id,
+                                        ModuleAtAddress(self)));
+  EXPECT_CALL(handler_, OnIndexedFrequency(
+      _,
+      process_id,
+      thread_id,
+      FrequencyDataMatches(self, kNumBasicBlocks, kExpectedFrequencyData)));
+  EXPECT_CALL(handler_, OnProcessEnded(_, process_id));
+
+  // Replay the log.
+  ASSERT_NO_FATAL_FAILURE(ReplayLogs(1));
+}
+
+TEST_F(BasicBlockEntryTest, SingleThreadedDllSampledEvents) {
+  // Request sampled counting. This must be set before the agent gets loaded.
+  const uint32 kSamplingPeriod = 10;
+  scoped_ptr<base::Environment> env(base::Environment::Create());
+  ASSERT_TRUE(env->SetVar(kSamplingPeriodEnvVar,
+                          base::UintToString(kSamplingPeriod)));
+
+  // Configure for BasicBlock mode.
+  ConfigureBasicBlockAgent();
+
+  ASSERT_NO_FATAL_FAILURE(StartService());
+  ASSERT_NO_FATAL_FAILURE(LoadDll());
+
+  // Simulate the process attach event.
+  SimulateModuleEvent(DLL_PROCESS_ATTACH);
+
+  // The frequency_data must be allocated and frequency_data must point to it.
+  ASSERT_NE(default_branch_data_, common_data_->frequency_data);
+  const uint32* frequency_data =
+      static_cast<const uint32*>(common_data_->frequency_data);
+
+  // Each sample counts for the entries since the previous one, so the count
+  // only lags behind by the current sampling interval, which is shorter than
+  // twice the period.
+  const uint32 kNumEntries = 1000;
+  for (uint32 i = 0; i < kNumEntries; ++i)
+    SimulateBasicBlockEntry(0);
+  EXPECT_GE(kNumEntries, frequency_data[0]);
+  EXPECT_LT(kNumEntries - 2 * kSamplingPeriod, frequency_data[0]);
+  EXPECT_EQ(0U, frequency_data[1]);
+
+  // Simulate the process detach event.
+  SimulateModuleEvent(DLL_PROCESS_DETACH);
+
+  // Unload the DLL and stop the service.
+  ASSERT_NO_FATAL_FAILURE(UnloadDll());
+  ASSERT_TRUE(env->UnSetVar(kSamplingPeriodEnvVar));
+
+  HMODULE self = ::GetModuleHandle(NULL);
+  DWORD process_id = ::GetCurrentProcessId();
+  DWORD thread_id = ::GetCurrentThreadId();
+
+  // Set up expectations for what should be in the trace.
+  EXPECT_CALL(handler_, OnProcessStarted(_, process_id, _));
+  EXPECT_CALL(handler_, OnProcessAttach(_,
+                                        process_id,
+                                        thread_id,
+                                        ModuleAtAddress(self)));
+  EXPECT_CALL(handler_, OnIndexedFrequency(_, process_id, thread_id, _));
+  EXPECT_CALL(handler_, OnProcessEnded(_, process_id));
+
+  // Replay the log.
+  ASSERT_NO_FATAL_FAILURE(ReplayLogs(1));
+}
+
 TEST_F(BasicBlockEntryTest, SingleThreadedExeBasicBlockEvents) {
   // Configure for BasicBlock mode.
   ConfigureBasicBlockAgent();
@@ -19,6 +19,7 @@
 #include <windows.h>  // NOLINT
 #include <psapi.h>
 #include <tlhelp32.h>
+#include <algorithm>
 #include <vector>
 
 #include "base/at_exit.h"
@@ -27,6 +28,7 @@
 #include "base/lazy_instance.h"
 #include "base/logging.h"
 #include "base/utf_string_conversions.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/win/pe_image.h"
 #include "sawbuck/common/com_utils.h"
 #include "syzygy/agent/common/process_utils.h"
@@ -35,6 +37,7 @@
 #include "syzygy/common/path_util.h"
 #include "syzygy/trace/client/client_utils.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
+#include "syzygy/trace/protocol/compact_batch.h"
 #include "syzygy/trace/rpc/rpc_helpers.h"
 
 using agent::client::Client;
@@ -55,6 +58,9 @@ void CopyArguments(ArgumentWord *dst, const ArgumentWord *src, size_t num) {
   }
 }
 
+// The maximum number of pages in a data page touch record.
+const size_t kMaxPagesPerRecord = 1024;
+
 }  // namespace
 
 BOOL WINAPI DllMain(HMODULE instance, DWORD reason, LPVOID reserved) {
@@ -175,6 +181,11 @@ class Client::ThreadLocalData {
   // Allocates a new enter event.
   TraceEnterEventData* AllocateEnterEvent();
 
+  // Logs a function entry to a compact batch record.
+  // @param function the function that was entered.
+  // @returns true on success, false if no buffer could be had for it.
+  bool LogCompactEnter(FuncAddr function);
+
   // Flushes the current trace file segment.
   bool FlushSegment();
 
@@ -188,9 +199,28 @@ class Client::ThreadLocalData {
   // The current batch record we're extending, if any.
   // This will point into the associated trace file segment's buffer.
   TraceBatchEnterData* batch;
+
+  // The current compact batch record we're extending, if any, the function
+  // of its last call entry, and its last entry if that is a repeat entry.
+  // These also point into the associated trace file segment's buffer.
+  TraceBatchEnterCompactData* compact_batch;
+  FuncAddr last_function;
+  uint8* last_repeat;
+
+ private:
+  // Commits an entry of @p size bytes, written at the segment's write
+  // pointer, to the current compact batch record.
+  void AppendCompactEntry(size_t size);
 };
 
-Client::Client() {
+Client::Client()
+    : session_ready_(false),
+      monitor_data_pages_(false),
+      compact_batches_(false),
+      async_session_(false),
+      session_creation_started_(false),
+      num_early_events_(0),
+      num_dropped_early_events_(0) {
 }
 
 Client::~Client() {
@@ -208,6 +238,14 @@ BOOL Client::DllMain(HMODULE /* module */,
       // Initialize logging ASAP.
       CommandLine::Init(0, NULL);
       ::common::InitLoggingForDll(L"call_trace");
+
+      {
+        scoped_ptr<base::Environment> env(base::Environment::Create());
+        monitor_data_pages_ = env->HasVar(::kSyzygyCallTraceDataPagesEnvVar);
+        compact_batches_ =
+            env->HasVar(::kSyzygyCallTraceCompactBatchesEnvVar);
+        async_session_ = env->HasVar(::kSyzygyCallTraceAsyncSessionEnvVar);
+      }
       break;
 
     case DLL_THREAD_ATTACH:
@@ -231,23 +269,28 @@ BOOL Client::DllMain(HMODULE /* module */,
 }
 
 void Client::OnClientProcessDetach() {
-  if (!session_.IsTracing())
+  // The function entries buffered while the session was created
+  // asynchronously are lost if it didn't complete.
+  if (!session_ready_)
     return;
 
+  LogDataPageTouches();
   session_.CloseSession();
   FreeThreadData();
   session_.FreeSharedMemory();
 }
 
 void Client::OnClientThreadDetach() {
-  if (!session_.IsTracing())
+  if (!session_ready_)
     return;
 
   // Get the thread data. If this thread has never called an instrumented
   // function, no thread local call trace data will be associated with it.
+  // It has no buffer if it only did so before the session was ready.
   ThreadLocalData* data = GetThreadData();
   if (data != NULL) {
-    session_.ReturnBuffer(&data->segment);
+    if (data->IsInitialized())
+      session_.ReturnBuffer(&data->segment);
     FreeThreadData(data);
   }
 }
@@ -310,8 +353,98 @@ void Client::LogEvent_ModuleEvent(ThreadLocalData *data,
   // We need to flush module events right away, so that the module is
   // defined in the trace file before events using that module start to
   // occur (in another thread).
-  if (reason == DLL_PROCESS_ATTACH)
+  if (reason == DLL_PROCESS_ATTACH) {
     data->FlushSegment();
+    MonitorDataPages(module);
+  }
+}
+
+void Client::MonitorDataPages(HMODULE module) {
+  DCHECK(module != NULL);
+
+  if (!monitor_data_pages_)
+    return;
+
+  // Modules are only monitored once.
+  for (size_t i = 0; i < monitored_modules_.size(); ++i) {
+    if (monitored_modules_[i].base_addr == module)
+      return;
+  }
+
+  base::win::PEImage image(module);
+  const IMAGE_NT_HEADERS* nt_headers = image.GetNTHeaders();
+  DCHECK(nt_headers != NULL);
+  MonitoredModule monitored_module = {
+      module,
+      nt_headers->OptionalHeader.SizeOfImage,
+      nt_headers->OptionalHeader.CheckSum,
+      nt_headers->FileHeader.TimeDateStamp };
+
+  if (!data_page_monitor_.MonitorModule(module)) {
+    LOG(ERROR) << "Failed to monitor the data pages of a module.";
+    return;
+  }
+  monitored_modules_.push_back(monitored_module);
+}
+
+void Client::LogDataPageTouches() {
+  DCHECK(session_.IsTracing());
+
+  if (monitored_modules_.empty())
+    return;
+
+  data_page_monitor_.StopMonitoring();
+  agent::common::DataPageMonitor::PageVector pages;
+  data_page_monitor_.GetTouchedPages(&pages);
+  uint32 page_size = data_page_monitor_.page_size();
+
+  ThreadLocalData* data = GetOrAllocateThreadData();
+  if (data == NULL)
+    return;
+  if (!data->IsInitialized() && !session_.AllocateBuffer(&data->segment)) {
+    LOG(ERROR) << "Failed to allocate trace buffer.";
+    return;
+  }
+
+  // The records below can't be extended by function entries.
+  data->batch = NULL;
+
+  for (size_t i = 0; i < monitored_modules_.size(); ++i) {
+    const MonitoredModule& module = monitored_modules_[i];
+    const uint8* base = reinterpret_cast<const uint8*>(module.base_addr);
+
+    std::vector<uint32> page_rvas;
+    for (size_t j = 0; j < pages.size(); ++j) {
+      const uint8* page = reinterpret_cast<const uint8*>(pages[j]);
+      if (page >= base && page < base + module.size)
+        page_rvas.push_back(page - base);
+    }
+
+    for (size_t first = 0; first < page_rvas.size();
+         first += kMaxPagesPerRecord) {
+      size_t num_pages = std::min(page_rvas.size() - first,
+                                  kMaxPagesPerRecord);
+      size_t record_size = FIELD_OFFSET(TraceDataPageTouches, page_rvas) +
+          num_pages * sizeof(page_rvas[0]);
+      if (!data->segment.CanAllocate(record_size) && !data->FlushSegment())
+        return;
+      DCHECK(data->segment.CanAllocate(record_size));
+
+      TraceDataPageTouches* record =
+          data->segment.AllocateTraceRecord<TraceDataPageTouches>(record_size);
+      record->module_base_addr = module.base_addr;
+      record->module_size = module.size;
+      record->module_checksum = module.checksum;
+      record->module_time_date_stamp = module.time_date_stamp;
+      record->page_size = page_size;
+      record->num_pages = num_pages;
+      for (size_t j = 0; j < num_pages; ++j)
+        record->page_rvas[j] = page_rvas[first + j];
+    }
+  }
+  monitored_modules_.clear();
+
+  data->FlushSegment();
 }
 
 
@@ -330,14 +463,19 @@ void Client::LogEvent_FunctionEntry(EntryFrame *entry_frame,
   ThreadLocalData *data = GetOrAllocateThreadData();
   CHECK(data != NULL) << "Failed to get call trace thread context.";
 
-  if (!session_.IsTracing() && !session_.IsDisabled()) {
+  if (!session_ready_) {
     base::AutoLock scoped_lock(init_lock_);
     if (session_.IsDisabled())
       return;
 
-    if (!session_.IsTracing()) {
+    if (!session_ready_) {
+      if (async_session_ &&
+          BufferEarlyEvent(entry_frame, function, module, reason)) {
+        return;
+      }
       if (!trace::client::InitializeRpcSession(&session_, &data->segment))
         return;
+      session_ready_ = true;
     }
   }
 
@@ -358,6 +496,11 @@ void Client::LogEvent_FunctionEntry(EntryFrame *entry_frame,
   //     the accuracy of the time for batch entry events. Do this before adding
   //     this event to the buffer in order to guarantee precision.
 
+  if (compact_batches_) {
+    data->LogCompactEnter(function);
+    return;
+  }
+
   // Capture the basic call info and timestamp.
   TraceEnterEventData* enter = data->AllocateEnterEvent();
   if (enter != NULL) {
@@ -366,6 +509,139 @@ void Client::LogEvent_FunctionEntry(EntryFrame *entry_frame,
   }
 }
 
+bool Client::BufferEarlyEvent(EntryFrame* entry_frame,
+                              FuncAddr function,
+                              HMODULE module,
+                              DWORD reason) {
+  init_lock_.AssertAcquired();
+  DCHECK(async_session_);
+
+  if (!session_creation_started_) {
+    // The thread only starts running once the loader lock is released, if
+    // it's held.
+    HANDLE thread = ::CreateThread(NULL, 0, &CreateSessionThreadProc, this,
+                                   0, NULL);
+    if (thread == NULL) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to create the session creation thread: "
+                 << com::LogWe(error) << ".";
+      async_session_ = false;
+      return false;
+    }
+    ::CloseHandle(thread);
+    session_creation_started_ = true;
+  }
+
+  if (num_early_events_ == kMaxEarlyEvents) {
+    ++num_dropped_early_events_;
+    return true;
+  }
+
+  EarlyEvent& event = early_events_[num_early_events_];
+  event.thread_id = ::GetCurrentThreadId();
+  event.retaddr = entry_frame->retaddr;
+  event.function = function;
+  event.module = module;
+  event.reason = reason;
+  ++num_early_events_;
+
+  return true;
+}
+
+DWORD WINAPI Client::CreateSessionThreadProc(void* param) {
+  Client* client = reinterpret_cast<Client*>(param);
+  DCHECK(client != NULL);
+
+  client->CreateSessionAsync();
+  return 0;
+}
+
+void Client::CreateSessionAsync() {
+  trace::client::TraceFileSegment segment;
+  if (!trace::client::InitializeRpcSession(&session_, &segment)) {
+    // The session is disabled, and the instrumented threads stop buffering
+    // their function entries.
+    base::AutoLock scoped_lock(init_lock_);
+    DCHECK(session_.IsDisabled());
+    num_early_events_ = 0;
+    return;
+  }
+
+  // The buffered function entries are written without holding the lock, as
+  // logging the modules may need the loader lock, which an instrumented
+  // thread waiting on ours may hold. The instrumented threads keep appending
+  // to the buffer meanwhile, so this goes on until it's drained.
+  size_t begin = 0;
+  while (true) {
+    size_t end = 0;
+    {
+      base::AutoLock scoped_lock(init_lock_);
+      end = num_early_events_;
+      if (begin == end) {
+        if (num_dropped_early_events_ != 0) {
+          LOG(WARNING) << "Dropped " << num_dropped_early_events_
+                       << " function entries while creating the session.";
+        }
+        session_ready_ = true;
+        break;
+      }
+    }
+
+    if (!ReplayEarlyEvents(begin, end, &segment))
+      LOG(ERROR) << "Failed to write the buffered function entries.";
+    begin = end;
+  }
+
+  session_.ReturnBuffer(&segment);
+}
+
+bool Client::ReplayEarlyEvents(size_t begin,
+                               size_t end,
+                               trace::client::TraceFileSegment* segment) {
+  DCHECK_LE(begin, end);
+  DCHECK_GE(kMaxEarlyEvents, end);
+  DCHECK(segment != NULL);
+
+  size_t i = begin;
+  while (i < end) {
+    const EarlyEvent& first_event = early_events_[i];
+    if (first_event.module != NULL &&
+        first_event.reason == DLL_PROCESS_ATTACH) {
+      // As in LogEvent_ModuleEvent, the module is defined before it's used.
+      if (agent::common::LogModule(first_event.module, &session_, segment))
+        MonitorDataPages(first_event.module);
+    }
+
+    // Write the run of entries of the thread to a batch record. A module
+    // entry point call starts a new run, as its module is logged first.
+    size_t num_calls = 1;
+    while (i + num_calls < end &&
+           early_events_[i + num_calls].thread_id == first_event.thread_id &&
+           early_events_[i + num_calls].module == NULL) {
+      ++num_calls;
+    }
+    size_t record_size = FIELD_OFFSET(TraceBatchEnterData, calls) +
+        num_calls * sizeof(TraceEnterEventData);
+    if (!segment->CanAllocate(record_size) &&
+        (!session_.ExchangeBuffer(segment) ||
+         !segment->CanAllocate(record_size))) {
+      return false;
+    }
+
+    TraceBatchEnterData* batch =
+        segment->AllocateTraceRecord<TraceBatchEnterData>(record_size);
+    batch->thread_id = first_event.thread_id;
+    batch->num_calls = num_calls;
+    for (size_t j = 0; j < num_calls; ++j) {
+      batch->calls[j].retaddr = early_events_[i + j].retaddr;
+      batch->calls[j].function = early_events_[i + j].function;
+    }
+    i += num_calls;
+  }
+
+  return true;
+}
+
 Client::ThreadLocalData* Client::GetThreadData() {
   return tls_.Get();
 }
@@ -398,7 +674,12 @@ void Client::FreeThreadData() {
     FreeThreadData(data);
 }
 
-Client::ThreadLocalData::ThreadLocalData(Client* c) : client(c), batch(NULL) {
+Client::ThreadLocalData::ThreadLocalData(Client* c)
+    : client(c),
+      batch(NULL),
+      compact_batch(NULL),
+      last_function(NULL),
+      last_repeat(NULL) {
 }
 
 TraceEnterEventData* Client::ThreadLocalData::AllocateEnterEvent() {
@@ -448,10 +729,69 @@ TraceEnterEventData* Client::ThreadLocalData::AllocateEnterEvent() {
   return &batch->calls[0];
 }
 
+bool Client::ThreadLocalData::LogCompactEnter(FuncAddr function) {
+  // Do we have a compact batch record that we can grow?
+  if (compact_batch != NULL) {
+    if (function == last_function) {
+      // Coalesce the call into the last entry if it is a repeat entry, or
+      // else into a new one.
+      if (last_repeat != NULL && IncrementCompactBatchRepeat(last_repeat))
+        return true;
+      if (segment.CanAllocateRaw(kCompactBatchRepeatSize)) {
+        uint8* repeat = segment.write_ptr;
+        EncodeCompactBatchRepeat(repeat);
+        AppendCompactEntry(kCompactBatchRepeatSize);
+        last_repeat = repeat;
+        return true;
+      }
+    } else if (segment.CanAllocateRaw(kMaxCompactBatchCallSize)) {
+      AppendCompactEntry(
+          EncodeCompactBatchCall(last_function, function, segment.write_ptr));
+      last_function = function;
+      last_repeat = NULL;
+      return true;
+    }
+  }
+
+  // Do we need to scarf a new buffer?
+  if (compact_batch != NULL ||
+      !segment.CanAllocate(sizeof(TraceBatchEnterCompactData) +
+                               kMaxCompactBatchCallSize)) {
+    if (!client->session_.ExchangeBuffer(&segment)) {
+      compact_batch = NULL;
+      return false;
+    }
+  }
+
+  compact_batch = segment.AllocateTraceRecord<TraceBatchEnterCompactData>();
+  compact_batch->thread_id = segment.header->thread_id;
+  AppendCompactEntry(
+      EncodeCompactBatchCall(NULL, function, segment.write_ptr));
+  last_function = function;
+  last_repeat = NULL;
+
+  return true;
+}
+
+void Client::ThreadLocalData::AppendCompactEntry(size_t size) {
+  DCHECK(compact_batch != NULL);
+
+  // As in AllocateEnterEvent, the entry has already been written past the end
+  // of the record, and the enclosures are grown from the outermost inward.
+  segment.write_ptr += size;
+  segment.header->segment_length += size;
+
+  RecordPrefix* prefix = trace::client::GetRecordPrefix(compact_batch);
+  prefix->size += size;
+
+  compact_batch->num_entries += 1;
+}
+
 bool Client::ThreadLocalData::FlushSegment() {
   DCHECK(IsInitialized());
 
   batch = NULL;
+  compact_batch = NULL;
   return client->session_.ExchangeBuffer(&segment);
 }
 
@@ -24,6 +24,7 @@
 
 #include "base/synchronization/lock.h"
 #include "base/threading/thread_local.h"
+#include "syzygy/agent/common/data_page_monitor.h"
 #include "syzygy/agent/common/entry_frame.h"
 #include "syzygy/trace/client/rpc_session.h"
 
@@ -72,6 +73,31 @@ class Client {
   // We keep a structure of this type for each thread.
   class ThreadLocalData;
 
+  // Identifies a module whose data pages are monitored.
+  struct MonitoredModule {
+    ModuleAddr base_addr;
+    size_t size;
+    uint32 checksum;
+    uint32 time_date_stamp;
+  };
+  typedef std::vector<MonitoredModule> MonitoredModuleVector;
+
+  // A function entry logged before the session is up, when it's created
+  // asynchronously.
+  struct EarlyEvent {
+    DWORD thread_id;
+    RetAddr retaddr;
+    FuncAddr function;
+    // The module and reason of a call to a module entry point, NULL and -1
+    // otherwise.
+    HMODULE module;
+    DWORD reason;
+  };
+
+  // The number of function entries buffered while the session is created
+  // asynchronously. The ones past these are dropped.
+  static const size_t kMaxEarlyEvents = 4096;
+
   // The functions we use to manage the thread local data.
   ThreadLocalData* GetThreadData();
   ThreadLocalData* GetOrAllocateThreadData();
@@ -86,6 +112,15 @@ class Client {
   void OnClientProcessDetach();
   void OnClientThreadDetach();
 
+  // Starts monitoring the data pages of an instrumented module, if requested
+  // through kSyzygyCallTraceDataPagesEnvVar.
+  // @param module the instrumented module.
+  void MonitorDataPages(HMODULE module);
+
+  // Writes the data pages that were touched in the monitored modules to the
+  // trace, and stops monitoring them.
+  void LogDataPageTouches();
+
   // This function will initialize a call trace session if none currently
   // exists and the event is DLL_PROCESS_ATTACH. It will then transmit a
   // module event record to the call trace service.
@@ -98,6 +133,33 @@ class Client {
                             HMODULE module,
                             DWORD reason);
 
+  // Buffers a function entry while the session is created asynchronously,
+  // kicking off its creation on the first call. Must be called under
+  // init_lock_. See LogEvent_FunctionEntry for the parameters.
+  // @returns true on success, false if the session has to be created
+  //     synchronously.
+  bool BufferEarlyEvent(EntryFrame* entry_frame,
+                        FuncAddr function,
+                        HMODULE module,
+                        DWORD reason);
+
+  // The entry point of the thread creating the session asynchronously.
+  // @param param the client.
+  static DWORD WINAPI CreateSessionThreadProc(void* param);
+
+  // Creates the session, hands the buffered function entries over to it,
+  // and lets the instrumented threads log to it directly.
+  void CreateSessionAsync();
+
+  // Writes buffered function entries to the trace.
+  // @param begin the index of the first entry to write.
+  // @param end the index past the last entry to write.
+  // @param segment the segment to write to.
+  // @returns true on success, false otherwise.
+  bool ReplayEarlyEvents(size_t begin,
+                         size_t end,
+                         trace::client::TraceFileSegment* segment);
+
   // Called by FunctionEntryHook and DllMainEntryHook.
   //
   // This function will log the entry into the given function.
@@ -124,8 +186,41 @@ class Client {
   // Our RPC session state.
   trace::client::RpcSession session_;
 
+  // Becomes true once the session is created, and the function entries
+  // buffered while it was created asynchronously, if any, are written.
+  volatile bool session_ready_;
+
   // This points to our per-thread state.
   mutable base::ThreadLocalPointer<ThreadLocalData> tls_;
+
+  // Whether the data pages of the instrumented modules are monitored.
+  bool monitor_data_pages_;
+
+  // Whether function entries are written as compact batch records.
+  bool compact_batches_;
+
+  // Whether the session is created by a thread of its own, rather than by
+  // the first instrumented thread. This keeps the round trips to the call
+  // trace service off the process startup, which usually runs under the
+  // loader lock.
+  bool async_session_;
+
+  // @name The function entries buffered while the session is created
+  //     asynchronously.
+  // @{
+  bool session_creation_started_;  // Under init_lock_.
+  EarlyEvent early_events_[kMaxEarlyEvents];
+  size_t num_early_events_;  // Under init_lock_.
+  size_t num_dropped_early_events_;  // Under init_lock_.
+  // @}
+
+  // Records the first touches of the data pages of the instrumented modules.
+  agent::common::DataPageMonitor data_page_monitor_;
+
+  // The modules whose data pages are monitored. This is only accessed under
+  // the loader lock, from module attach and detach events, or by the thread
+  // creating the session asynchronously before the session is ready.
+  MonitoredModuleVector monitored_modules_;
 };
 
 }  // namespace client
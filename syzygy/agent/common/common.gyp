@@ -21,6 +21,8 @@
       'target_name': 'agent_common_lib',
       'type': 'static_library',
       'sources': [
+        'data_page_monitor.cc',
+        'data_page_monitor.h',
         'dlist.cc',
         'dlist.h',
         'dll_notifications.cc',
@@ -45,6 +47,7 @@
       'type': 'executable',
       'sources': [
         'agent_common_unittests_main.cc',
+        'data_page_monitor_unittest.cc',
         'dlist_unittest.cc',
         'dll_notifications_unittest.cc',
         'process_utils_unittest.cc',
@@ -0,0 +1,255 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/common/data_page_monitor.h"
+
+#include <algorithm>
+#include <set>
+
+#include "base/logging.h"
+#include "base/win/pe_image.h"
+#include "sawbuck/common/com_utils.h"
+
+namespace agent {
+namespace common {
+
+namespace {
+
+// The name of the resource section. Resources may be read by the kernel, which
+// doesn't play well with guard pages.
+const char kResourceSectionName[] = ".rsrc";
+
+// The monitor whose vectored exception handler is installed, if any.
+DataPageMonitor* active_monitor = NULL;
+
+size_t GetPageSize() {
+  SYSTEM_INFO system_info = {};
+  ::GetSystemInfo(&system_info);
+  return system_info.dwPageSize;
+}
+
+}  // namespace
+
+DataPageMonitor::DataPageMonitor()
+    : page_size_(GetPageSize()),
+      handler_(NULL),
+      num_touched_pages_(0) {
+  DCHECK_LT(0U, page_size_);
+}
+
+DataPageMonitor::~DataPageMonitor() {
+  StopMonitoring();
+}
+
+bool DataPageMonitor::MonitorModule(HMODULE module) {
+  return MonitorSections(module, false);
+}
+
+bool DataPageMonitor::MonitorModuleCode(HMODULE module) {
+  return MonitorSections(module, true);
+}
+
+bool DataPageMonitor::MonitorSections(HMODULE module, bool code) {
+  DCHECK(module != NULL);
+
+  base::win::PEImage image(module);
+  if (!image.VerifyMagic()) {
+    LOG(ERROR) << "Module is not a valid PE image.";
+    return false;
+  }
+
+  const uint8* base = reinterpret_cast<const uint8*>(module);
+  for (UINT i = 0; i < image.GetNumSections(); ++i) {
+    const IMAGE_SECTION_HEADER* section = image.GetSectionHeader(i);
+    DCHECK(section != NULL);
+
+    const DWORD kCodeMask = IMAGE_SCN_CNT_CODE | IMAGE_SCN_MEM_EXECUTE;
+    const DWORD kDataMask = IMAGE_SCN_CNT_INITIALIZED_DATA |
+        IMAGE_SCN_CNT_UNINITIALIZED_DATA;
+    if ((section->Characteristics & IMAGE_SCN_MEM_DISCARDABLE) != 0)
+      continue;
+    if (code) {
+      if ((section->Characteristics & kCodeMask) == 0)
+        continue;
+    } else if ((section->Characteristics & kDataMask) == 0 ||
+               (section->Characteristics & kCodeMask) != 0) {
+      continue;
+    }
+    if (::strncmp(reinterpret_cast<const char*>(section->Name),
+                  kResourceSectionName,
+                  sizeof(section->Name)) == 0) {
+      continue;
+    }
+
+    if (!MonitorRange(base + section->VirtualAddress,
+                      section->Misc.VirtualSize)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool DataPageMonitor::MonitorRange(const void* start, size_t size) {
+  DCHECK(start != NULL);
+  DCHECK(active_monitor == NULL || active_monitor == this);
+
+  if (size == 0)
+    return true;
+
+  // Extend the range to whole pages.
+  uintptr_t range_start = reinterpret_cast<uintptr_t>(start);
+  uintptr_t range_end = range_start + size;
+  range_start -= range_start % page_size_;
+  range_end += (page_size_ - range_end % page_size_) % page_size_;
+
+  Range range = { reinterpret_cast<const uint8*>(range_start),
+                  reinterpret_cast<const uint8*>(range_end) };
+  {
+    base::AutoLock auto_lock(lock_);
+    ranges_.push_back(range);
+    touched_pages_.resize(
+        touched_pages_.size() + (range_end - range_start) / page_size_);
+  }
+
+  if (handler_ == NULL) {
+    active_monitor = this;
+    handler_ = ::AddVectoredExceptionHandler(TRUE, &OnException);
+    if (handler_ == NULL) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to add vectored exception handler: "
+                 << com::LogWe(error) << ".";
+      active_monitor = NULL;
+      return false;
+    }
+  }
+
+  return SetGuard(range, true);
+}
+
+void DataPageMonitor::StopMonitoring() {
+  if (handler_ == NULL)
+    return;
+
+  RangeVector ranges;
+  {
+    base::AutoLock auto_lock(lock_);
+    ranges.swap(ranges_);
+  }
+
+  // Restore the protection of the pages before removing the handler, so that
+  // no guard page violation goes unhandled. A module may have been unloaded
+  // since it was monitored, so failures are ignored.
+  for (size_t i = 0; i < ranges.size(); ++i)
+    SetGuard(ranges[i], false);
+
+  ::RemoveVectoredExceptionHandler(handler_);
+  handler_ = NULL;
+  active_monitor = NULL;
+}
+
+void DataPageMonitor::GetTouchedPages(PageVector* pages) const {
+  DCHECK(pages != NULL);
+
+  base::AutoLock auto_lock(lock_);
+
+  // Two threads may touch a page concurrently, in which case it may have been
+  // recorded twice.
+  std::set<const void*> seen_pages;
+  pages->clear();
+  for (size_t i = 0; i < num_touched_pages_; ++i) {
+    if (seen_pages.insert(touched_pages_[i]).second)
+      pages->push_back(touched_pages_[i]);
+  }
+}
+
+LONG CALLBACK DataPageMonitor::OnException(EXCEPTION_POINTERS* exception) {
+  DCHECK(exception != NULL);
+
+  const EXCEPTION_RECORD* record = exception->ExceptionRecord;
+  if (record->ExceptionCode != STATUS_GUARD_PAGE_VIOLATION ||
+      record->NumberParameters < 2) {
+    return EXCEPTION_CONTINUE_SEARCH;
+  }
+
+  // The second parameter is the address that was accessed.
+  DataPageMonitor* monitor = active_monitor;
+  if (monitor == NULL ||
+      !monitor->RecordTouch(
+          reinterpret_cast<const void*>(record->ExceptionInformation[1]))) {
+    return EXCEPTION_CONTINUE_SEARCH;
+  }
+
+  // The guard was removed when the exception was raised, so the faulting
+  // instruction can simply be executed again.
+  return EXCEPTION_CONTINUE_EXECUTION;
+}
+
+bool DataPageMonitor::RecordTouch(const void* address) {
+  const uint8* touched = reinterpret_cast<const uint8*>(address);
+
+  base::AutoLock auto_lock(lock_);
+  for (size_t i = 0; i < ranges_.size(); ++i) {
+    if (touched < ranges_[i].start || touched >= ranges_[i].end)
+      continue;
+
+    const uint8* page = touched - (touched - ranges_[i].start) % page_size_;
+    if (num_touched_pages_ < touched_pages_.size())
+      touched_pages_[num_touched_pages_++] = page;
+    return true;
+  }
+
+  return false;
+}
+
+bool DataPageMonitor::SetGuard(const Range& range, bool guard) {
+  const uint8* address = range.start;
+  while (address < range.end) {
+    MEMORY_BASIC_INFORMATION info = {};
+    if (::VirtualQuery(address, &info, sizeof(info)) != sizeof(info)) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "VirtualQuery failed: " << com::LogWe(error) << ".";
+      return false;
+    }
+
+    const uint8* region_end = std::min(
+        reinterpret_cast<const uint8*>(info.BaseAddress) + info.RegionSize,
+        range.end);
+    DWORD protect = info.Protect & ~PAGE_GUARD;
+    if (guard)
+      protect |= PAGE_GUARD;
+
+    // Guard pages can't be inaccessible, and uncommitted pages can't be
+    // touched.
+    if (info.State == MEM_COMMIT && (info.Protect & PAGE_NOACCESS) == 0 &&
+        protect != info.Protect) {
+      DWORD old_protect = 0;
+      if (!::VirtualProtect(const_cast<uint8*>(address),
+                            region_end - address,
+                            protect,
+                            &old_protect)) {
+        DWORD error = ::GetLastError();
+        LOG(ERROR) << "VirtualProtect failed: " << com::LogWe(error) << ".";
+        return false;
+      }
+    }
+
+    address = region_end;
+  }
+
+  return true;
+}
+
+}  // namespace common
+}  // namespace agent
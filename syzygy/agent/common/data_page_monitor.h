@@ -0,0 +1,128 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a utility class that records the order in which the pages of a
+// range of memory, typically the data or code sections of a module, are first
+// touched.
+// This is done by guarding the pages with PAGE_GUARD, and by handling the
+// resulting guard page violations in a vectored exception handler. The system
+// removes the guard of a page when it raises the exception, so each page is
+// only reported once.
+//
+// Note that the kernel doesn't raise guard page violations, but fails the
+// system calls that touch guarded pages instead. Such a call fails once,
+// after which the page has lost its guard and is reported as touched.
+
+#ifndef SYZYGY_AGENT_COMMON_DATA_PAGE_MONITOR_H_
+#define SYZYGY_AGENT_COMMON_DATA_PAGE_MONITOR_H_
+
+#include <windows.h>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/synchronization/lock.h"
+
+namespace agent {
+namespace common {
+
+// Records the first touch of the pages of ranges of memory. There may only be
+// one monitor with monitored ranges at any given time.
+class DataPageMonitor {
+ public:
+  typedef std::vector<const void*> PageVector;
+
+  DataPageMonitor();
+  ~DataPageMonitor();
+
+  // Starts monitoring the data sections of a module. Code, discardable and
+  // resource sections are left alone.
+  // @param module the module whose data sections are to be monitored.
+  // @returns true on success, false on failure.
+  bool MonitorModule(HMODULE module);
+
+  // Starts monitoring the code sections of a module. A code page is reported
+  // as touched when it is first executed, or first read.
+  // @param module the module whose code sections are to be monitored.
+  // @returns true on success, false on failure.
+  bool MonitorModuleCode(HMODULE module);
+
+  // Starts monitoring the pages overlapping a range of memory. This is exposed
+  // for testing.
+  // @param start the start of the range.
+  // @param size the size of the range, in bytes.
+  // @returns true on success, false on failure.
+  bool MonitorRange(const void* start, size_t size);
+
+  // Stops monitoring all ranges, restoring the protection of the pages that
+  // were never touched.
+  void StopMonitoring();
+
+  // Gets the pages that were touched so far.
+  // @param pages receives the start addresses of the touched pages, in the
+  //     order they were first touched.
+  void GetTouchedPages(PageVector* pages) const;
+
+  // @returns the size of the pages that are monitored.
+  size_t page_size() const { return page_size_; }
+
+ private:
+  struct Range {
+    const uint8* start;
+    const uint8* end;
+  };
+  typedef std::vector<Range> RangeVector;
+
+  // Starts monitoring the data or code sections of a module.
+  // @param module the module whose sections are to be monitored.
+  // @param code true to monitor the code sections, false to monitor the data
+  //     sections.
+  // @returns true on success, false on failure.
+  bool MonitorSections(HMODULE module, bool code);
+
+  // The vectored exception handler that records the touched pages.
+  static LONG CALLBACK OnException(EXCEPTION_POINTERS* exception);
+
+  // Records the touch of a monitored page.
+  // @param address the address that was touched.
+  // @returns true if @p address is in a monitored range, false otherwise.
+  bool RecordTouch(const void* address);
+
+  // Sets or clears the guard of the pages of a range.
+  // @param range the range to update.
+  // @param guard true to set the guard, false to clear it.
+  // @returns true on success, false on failure.
+  static bool SetGuard(const Range& range, bool guard);
+
+  // The size of a page.
+  size_t page_size_;
+
+  // The handle of the vectored exception handler, if installed.
+  void* handler_;
+
+  // Protects the ranges and touched pages, which are read from the exception
+  // handler. The exception handler must not allocate memory, as it may run
+  // while the faulting thread holds the heap lock, so the touched pages are
+  // recorded in a vector that is sized up front.
+  mutable base::Lock lock_;
+  RangeVector ranges_;  // Under lock_.
+  PageVector touched_pages_;  // Under lock_.
+  size_t num_touched_pages_;  // Under lock_.
+
+  DISALLOW_COPY_AND_ASSIGN(DataPageMonitor);
+};
+
+}  // namespace common
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_COMMON_DATA_PAGE_MONITOR_H_
@@ -0,0 +1,117 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/common/data_page_monitor.h"
+
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace common {
+
+namespace {
+
+class DataPageMonitorTest : public testing::Test {
+ public:
+  DataPageMonitorTest() : pages_(NULL) {
+  }
+
+  virtual void SetUp() OVERRIDE {
+    pages_ = reinterpret_cast<uint8*>(
+        ::VirtualAlloc(NULL, kNumPages * monitor_.page_size(),
+                       MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+    ASSERT_TRUE(pages_ != NULL);
+  }
+
+  virtual void TearDown() OVERRIDE {
+    monitor_.StopMonitoring();
+    if (pages_ != NULL)
+      ASSERT_TRUE(::VirtualFree(pages_, 0, MEM_RELEASE));
+  }
+
+  uint8* page(size_t index) {
+    return pages_ + index * monitor_.page_size();
+  }
+
+  static const size_t kNumPages = 4;
+
+  DataPageMonitor monitor_;
+  uint8* pages_;
+};
+
+const size_t DataPageMonitorTest::kNumPages;
+
+}  // namespace
+
+TEST_F(DataPageMonitorTest, RecordsFirstTouches) {
+  // Monitor everything but the first byte of the first page, which should
+  // still be covered.
+  ASSERT_TRUE(monitor_.MonitorRange(pages_ + 1,
+                                    kNumPages * monitor_.page_size() - 1));
+
+  // Read and write the pages out of order, touching some of them repeatedly.
+  page(2)[10] = 1;
+  EXPECT_EQ(0, page(0)[20]);
+  page(2)[30] = 2;
+  page(3)[0] = 3;
+  page(0)[40] = 4;
+
+  DataPageMonitor::PageVector touched_pages;
+  monitor_.GetTouchedPages(&touched_pages);
+  ASSERT_EQ(3U, touched_pages.size());
+  EXPECT_EQ(page(2), touched_pages[0]);
+  EXPECT_EQ(page(0), touched_pages[1]);
+  EXPECT_EQ(page(3), touched_pages[2]);
+
+  // The pages hold what was written to them.
+  EXPECT_EQ(1, page(2)[10]);
+  EXPECT_EQ(2, page(2)[30]);
+  EXPECT_EQ(3, page(3)[0]);
+  EXPECT_EQ(4, page(0)[40]);
+
+  // Touches are no longer recorded once monitoring stops, and the pages that
+  // were never touched are accessible again.
+  monitor_.StopMonitoring();
+  page(1)[0] = 5;
+  monitor_.GetTouchedPages(&touched_pages);
+  EXPECT_EQ(3U, touched_pages.size());
+}
+
+TEST_F(DataPageMonitorTest, RecordsExecutedPages) {
+  DWORD old_protect = 0;
+  ASSERT_TRUE(::VirtualProtect(pages_, kNumPages * monitor_.page_size(),
+                               PAGE_EXECUTE_READWRITE, &old_protect));
+
+  // Place a ret instruction on the second page, and execute it.
+  page(1)[0] = 0xC3;
+  ASSERT_TRUE(monitor_.MonitorRange(pages_, kNumPages * monitor_.page_size()));
+  typedef void (*Function)();
+  reinterpret_cast<Function>(page(1))();
+
+  DataPageMonitor::PageVector touched_pages;
+  monitor_.GetTouchedPages(&touched_pages);
+  ASSERT_EQ(1U, touched_pages.size());
+  EXPECT_EQ(page(1), touched_pages[0]);
+}
+
+TEST_F(DataPageMonitorTest, MonitorEmptyRange) {
+  ASSERT_TRUE(monitor_.MonitorRange(pages_, 0));
+  page(0)[0] = 1;
+
+  DataPageMonitor::PageVector touched_pages;
+  monitor_.GetTouchedPages(&touched_pages);
+  EXPECT_TRUE(touched_pages.empty());
+}
+
+}  // namespace common
+}  // namespace agent
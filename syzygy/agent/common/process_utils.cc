@@ -16,9 +16,13 @@
 
 #include <psapi.h>
 
+#include "base/environment.h"
 #include "base/logging.h"
+#include "base/utf_string_conversions.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/win/pe_image.h"
 #include "sawbuck/common/com_utils.h"
+#include "syzygy/common/live_frequency_data.h"
 #include "syzygy/common/path_util.h"
 #include "syzygy/trace/client/rpc_session.h"
 
@@ -141,5 +145,36 @@ bool LogModule(HMODULE module,
   return true;
 }
 
+::common::LiveFrequencyData* CreateLiveFrequencyData(
+    HMODULE module, const ::common::IndexedFrequencyData& data) {
+  DCHECK(module != NULL);
+
+  scoped_ptr<base::Environment> env(base::Environment::Create());
+  std::string prefix;
+  if (env.get() == NULL ||
+      !env->GetVar(::common::kLiveFrequencyDataEnvVar, &prefix) ||
+      prefix.empty()) {
+    return NULL;
+  }
+
+  wchar_t module_path[MAX_PATH] = { 0 };
+  if (::GetModuleFileName(module, module_path, arraysize(module_path)) == 0) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to get module name: " << com::LogWe(error) << ".";
+    return NULL;
+  }
+
+  std::wstring name = ::common::GetLiveFrequencyDataName(
+      UTF8ToWide(prefix), ::GetCurrentProcessId(),
+      base::FilePath(module_path).BaseName().value());
+
+  scoped_ptr< ::common::LiveFrequencyData> live_data(
+      new ::common::LiveFrequencyData());
+  if (!live_data->Create(name, module, data))
+    return NULL;
+
+  return live_data.release();
+}
+
 }  // namespace common
 }  // namespace agent
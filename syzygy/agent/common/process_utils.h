@@ -21,6 +21,11 @@
 #include <vector>
 
 // Forward declarations.
+namespace common {
+struct IndexedFrequencyData;
+class LiveFrequencyData;
+}  // namespace common
+
 namespace trace {
 namespace client {
 class RpcSession;
@@ -53,6 +58,15 @@ bool LogModule(HMODULE module,
                trace::client::RpcSession* session,
                trace::client::TraceFileSegment* segment);
 
+// Creates the live frequency data section of a module, if a prefix for these
+// sections is given through ::common::kLiveFrequencyDataEnvVar.
+// @param module the instrumented module.
+// @param data the frequency data of @p module.
+// @returns the new section, owned by the caller, or NULL if no section is
+//     requested or it couldn't be created.
+::common::LiveFrequencyData* CreateLiveFrequencyData(
+    HMODULE module, const ::common::IndexedFrequencyData& data);
+
 }  // namespace common
 }  // namespace agent
 
@@ -20,7 +20,9 @@
 #include "base/file_util.h"
 #include "base/utf_string_conversions.h"
 #include "base/files/scoped_temp_dir.h"
+#include "base/memory/scoped_ptr.h"
 #include "gtest/gtest.h"
+#include "syzygy/common/live_frequency_data.h"
 #include "syzygy/trace/client/rpc_session.h"
 #include "syzygy/trace/common/unittest_util.h"
 #include "syzygy/trace/parse/unittest_util.h"
@@ -168,5 +170,40 @@ TEST_F(ProcessUtilsTest, LogModule) {
   ASSERT_NO_FATAL_FAILURE(ReplayLogs(1));
 }
 
+TEST_F(ProcessUtilsTest, CreateLiveFrequencyData) {
+  HMODULE exe_module = ::GetModuleHandle(NULL);
+  ::common::IndexedFrequencyData data = {};
+  data.num_entries = 4;
+  data.num_columns = 1;
+  data.frequency_size = 1;
+  data.data_type = ::common::IndexedFrequencyData::COVERAGE;
+
+  // Nothing gets created unless a prefix is given.
+  scoped_ptr<base::Environment> env(base::Environment::Create());
+  ASSERT_TRUE(env.get() != NULL);
+  env->UnSetVar(::common::kLiveFrequencyDataEnvVar);
+  scoped_ptr< ::common::LiveFrequencyData> live_data(
+      CreateLiveFrequencyData(exe_module, data));
+  EXPECT_TRUE(live_data.get() == NULL);
+
+  ASSERT_TRUE(env->SetVar(::common::kLiveFrequencyDataEnvVar,
+                          "ProcessUtilsTest"));
+  live_data.reset(CreateLiveFrequencyData(exe_module, data));
+  env->UnSetVar(::common::kLiveFrequencyDataEnvVar);
+  ASSERT_TRUE(live_data.get() != NULL);
+
+  // The section can be found from its name.
+  wchar_t exe_path[MAX_PATH] = { 0 };
+  ASSERT_NE(0U, ::GetModuleFileName(exe_module, exe_path,
+                                    arraysize(exe_path)));
+  std::wstring name = ::common::GetLiveFrequencyDataName(
+      L"ProcessUtilsTest", ::GetCurrentProcessId(),
+      base::FilePath(exe_path).BaseName().value());
+  ::common::LiveFrequencyData reader;
+  ASSERT_TRUE(reader.Open(name));
+  EXPECT_EQ(4U, reader.header()->num_entries);
+  EXPECT_EQ(4U, reader.frequency_data_size());
+}
+
 }  // namespace common
 }  // namespace agent
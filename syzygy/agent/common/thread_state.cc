@@ -16,6 +16,8 @@
 
 #include "syzygy/agent/common/thread_state.h"
 
+#include <algorithm>
+
 namespace agent {
 namespace common {
 
@@ -30,7 +32,10 @@ ThreadStateBase::~ThreadStateBase() {
   DCHECK(IsListEmpty(&entry_));
 }
 
-ThreadStateManager::ThreadStateManager() {
+const size_t ThreadStateManager::kMinScavengeThreshold;
+
+ThreadStateManager::ThreadStateManager()
+    : marked_items_(0), scavenge_threshold_(kMinScavengeThreshold) {
   InitializeListHead(&active_items_);
   InitializeListHead(&death_row_items_);
 }
@@ -85,6 +90,7 @@ void ThreadStateManager::Unregister(ThreadStateBase* item) {
 void ThreadStateManager::MarkForDeath(ThreadStateBase* item) {
   DCHECK(item != NULL);
 
+  bool should_scavenge = false;
   {
     base::AutoLock auto_lock(lock_);
 
@@ -96,16 +102,21 @@ void ThreadStateManager::MarkForDeath(ThreadStateBase* item) {
     // below, in the unlikely case that the item is being marked from another
     // thread than it's own.
     RemoveEntryList(&item->entry_);
+
+    should_scavenge = marked_items_ >= scavenge_threshold_;
   }
 
-  // Use this opportunity to scavenge existing thread states on death row.
-  Scavenge();
+  // Use this opportunity to scavenge existing thread states on death row, if
+  // enough of them have accumulated since the last time.
+  if (should_scavenge)
+    Scavenge();
 
   // Mark item for death, for later scavenging.
   {
     base::AutoLock auto_lock(lock_);
 
     InsertHeadList(&death_row_items_, &item->entry_);
+    ++marked_items_;
   }
 }
 
@@ -121,7 +132,12 @@ bool ThreadStateManager::Scavenge() {
 
     // Put all of the death row items belonging
     // to dead threads into dead_items.
-    GatherDeadItemsUnlocked(&dead_items);
+    size_t remaining_items = GatherDeadItemsUnlocked(&dead_items);
+
+    // Wait for at least as many new items as there are survivors before
+    // walking the death row list again.
+    marked_items_ = 0;
+    scavenge_threshold_ = std::max(kMinScavengeThreshold, remaining_items);
 
     // Return whether or not the thread state manager is no longer holding
     // any items.
@@ -136,16 +152,17 @@ bool ThreadStateManager::Scavenge() {
   return has_more_items;
 }
 
-void ThreadStateManager::GatherDeadItemsUnlocked(LIST_ENTRY* dead_items) {
+size_t ThreadStateManager::GatherDeadItemsUnlocked(LIST_ENTRY* dead_items) {
   DCHECK(dead_items != NULL);
   DCHECK(IsListEmpty(dead_items));
   lock_.AssertAcquired();
 
   // Return if the death row items list is empty.
   if (IsListEmpty(&death_row_items_))
-    return;
+    return 0;
 
   // Walk the death row items list, looking for items owned by dead threads.
+  size_t remaining_items = 0;
   ThreadStateBase* item =
       CONTAINING_RECORD(death_row_items_.Flink, ThreadStateBase, entry_);
   while (item != NULL) {
@@ -159,10 +176,14 @@ void ThreadStateManager::GatherDeadItemsUnlocked(LIST_ENTRY* dead_items) {
     if (IsThreadDead(item)) {
       RemoveEntryList(&item->entry_);
       InsertTailList(dead_items, &item->entry_);
+    } else {
+      ++remaining_items;
     }
 
     item = next_item;
   }
+
+  return remaining_items;
 }
 
 bool ThreadStateManager::IsThreadDead(ThreadStateBase* item) {
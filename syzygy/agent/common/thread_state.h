@@ -70,10 +70,15 @@ class ThreadStateManager {
 
   // Transfer @p item from the list of active items to the death row list. This
   // does not delete @p item immediately if it's called on @p items' own
-  // thread.
+  // thread. The death row gets scavenged in batches, once enough items have
+  // been marked for death since the last scavenge, so that the cost of a
+  // thread detach doesn't grow with the number of threads in the process.
   void MarkForDeath(ThreadStateBase* item);
 
  protected:
+  // The minimum number of items to mark for death between two scavenges.
+  static const size_t kMinScavengeThreshold = 16;
+
   // A helper method which gathers up any dead items from the death row list.
   // @returns true iff there are any items still being managed by this
   //     ThreadStateManager instance upon this functions return.
@@ -82,7 +87,8 @@ class ThreadStateManager {
   // Gathers all items which have been marked for death whose owning threads
   // have terminated into @p dead_items. These items can subsequently be
   // deleted using the Delete() method.
-  void GatherDeadItemsUnlocked(LIST_ENTRY* dead_items);
+  // @returns the number of items left on the death row list.
+  size_t GatherDeadItemsUnlocked(LIST_ENTRY* dead_items);
 
   // Deletes (using the delete operator) each item in @p items.
   static void DeleteItems(LIST_ENTRY* items);
@@ -101,6 +107,14 @@ class ThreadStateManager {
   // death. Accessed under lock_.
   LIST_ENTRY death_row_items_;
 
+  // The number of items marked for death since the last scavenge, and the
+  // number of them that triggers the next one. The threshold grows with the
+  // number of items left on death row by the last scavenge, which keeps the
+  // cost of scavenging amortized over the thread detaches. Accessed under
+  // lock_.
+  size_t marked_items_;
+  size_t scavenge_threshold_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(ThreadStateManager);
 };
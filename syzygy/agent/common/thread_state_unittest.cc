@@ -14,6 +14,8 @@
 
 #include "syzygy/agent/common/thread_state.h"
 
+#include <vector>
+
 #include "base/atomic_ref_count.h"
 #include "base/bind.h"
 #include "base/synchronization/waitable_event.h"
@@ -47,6 +49,7 @@ class TestThreadStateManager : public ThreadStateManager {
   // Expose protected members for unit-testing.
   using ThreadStateManager::Scavenge;
   using ThreadStateManager::IsThreadDead;
+  using ThreadStateManager::kMinScavengeThreshold;
 
   // Returns true if the there are no active thread state items being managed.
   bool HasActiveItems() {
@@ -236,6 +239,36 @@ TEST_F(ThreadStateTest, LifeCycle) {
   EXPECT_TRUE(base::AtomicRefCountIsZero(&thread_states_));
 }
 
+TEST_F(ThreadStateTest, MarkForDeathScavengesInBatches) {
+  const size_t kItemCount = TestThreadStateManager::kMinScavengeThreshold + 1;
+  std::vector<TestThreadState*> thread_states(kItemCount, NULL);
+  for (size_t i = 0; i < kItemCount; ++i) {
+    ASSERT_NO_FATAL_FAILURE(CreateThreadState(&thread_states[i]));
+    ASSERT_NO_FATAL_FAILURE(RegisterThreadState(thread_states[i]));
+  }
+
+  // Stop the thread owning the items, so that they all can be scavenged as
+  // soon as they're on death row.
+  worker_thread_.Stop();
+
+  // Marking items for death doesn't scavenge until the threshold is reached.
+  for (size_t i = 0; i < kItemCount - 1; ++i) {
+    manager_->MarkForDeath(thread_states[i]);
+    EXPECT_TRUE(manager_->IsOnDeathRow(thread_states[i]));
+  }
+  EXPECT_EQ(static_cast<base::subtle::Atomic32>(kItemCount),
+            base::subtle::NoBarrier_Load(&thread_states_));
+
+  // The next item triggers the scavenge of the previous ones, but survives
+  // it.
+  manager_->MarkForDeath(thread_states[kItemCount - 1]);
+  EXPECT_TRUE(manager_->IsOnDeathRow(thread_states[kItemCount - 1]));
+  EXPECT_TRUE(base::AtomicRefCountIsOne(&thread_states_));
+
+  EXPECT_FALSE(manager_->Scavenge());
+  EXPECT_TRUE(base::AtomicRefCountIsZero(&thread_states_));
+}
+
 TEST_F(ThreadStateTest, DeletesAllThreadStatesOnDestruction) {
   TestThreadState* thread_state = NULL;
   ASSERT_NO_FATAL_FAILURE(CreateThreadState(&thread_state));
@@ -19,6 +19,7 @@
 #include "base/command_line.h"
 #include "base/environment.h"
 #include "base/lazy_instance.h"
+#include "base/stringprintf.h"
 #include "base/utf_string_conversions.h"
 #include "base/memory/scoped_ptr.h"
 #include "sawbuck/common/com_utils.h"
@@ -110,6 +111,19 @@ using ::common::IndexedFrequencyData;
 using ::common::kBasicBlockCoverageAgentId;
 using ::common::kBasicBlockFrequencyDataVersion;
 
+// Returns true if @p coverage_data looks like it was injected by the
+// coverage transform.
+bool CoverageDataIsValid(const IndexedFrequencyData* coverage_data) {
+  DCHECK(coverage_data != NULL);
+  return coverage_data->agent_id == kBasicBlockCoverageAgentId &&
+      coverage_data->version == kBasicBlockFrequencyDataVersion &&
+      coverage_data->frequency_size == 1U &&
+      coverage_data->num_columns == 1U &&
+      (coverage_data->data_type == IndexedFrequencyData::COVERAGE ||
+       coverage_data->data_type == IndexedFrequencyData::EDGE_COVERAGE ||
+       coverage_data->data_type == IndexedFrequencyData::PAGE_COVERAGE);
+}
+
 // All tracing runs through this object.
 base::LazyInstance<agent::coverage::Coverage> static_coverage_instance =
     LAZY_INSTANCE_INITIALIZER;
@@ -120,11 +134,21 @@ Coverage* Coverage::Instance() {
   return static_coverage_instance.Pointer();
 }
 
-Coverage::Coverage() {
+const char Coverage::kEdgeBitmapEnvVar[] = "SYZYGY_COVERAGE_EDGE_BITMAP";
+const char Coverage::kSharedBitmapEnvVar[] = "SYZYGY_COVERAGE_SHARED_BITMAP";
+
+Coverage::Coverage() : edge_bitmap_(NULL), edge_bitmap_size_(0) {
   trace::client::InitializeRpcSession(&session_, &segment_);
 }
 
 Coverage::~Coverage() {
+  RecordPageCoverage();
+  ReleaseSharedBitmaps();
+
+  if (edge_bitmap_ != NULL) {
+    ::UnmapViewOfFile(edge_bitmap_);
+    edge_bitmap_ = NULL;
+  }
 }
 
 void WINAPI Coverage::EntryHook(EntryHookFrame* entry_frame) {
@@ -153,6 +177,27 @@ void WINAPI Coverage::EntryHook(EntryHookFrame* entry_frame) {
   Coverage* coverage = Coverage::Instance();
   DCHECK(coverage != NULL);
 
+  // Edge coverage may be routed to a shared memory bitmap rather than to the
+  // trace file. This works without a call trace service.
+  if (entry_frame->coverage_data->data_type ==
+          IndexedFrequencyData::EDGE_COVERAGE &&
+      coverage->MapEdgeBitmap(entry_frame->coverage_data)) {
+    LOG(INFO) << "Coverage client initialized with a shared edge bitmap.";
+    return;
+  }
+
+  // The coverage data may also be exposed live through shared memory, in
+  // which case it doesn't go to the trace either. The page coverage bitmap is
+  // only filled in on tear-down, so there's no point in exposing it live.
+  bool page_coverage = entry_frame->coverage_data->data_type ==
+      IndexedFrequencyData::PAGE_COVERAGE;
+  if (!page_coverage &&
+      coverage->InitializeLiveCoverageData(module,
+                                           entry_frame->coverage_data)) {
+    LOG(INFO) << "Coverage client initialized with live coverage data.";
+    return;
+  }
+
   // If the call trace client is not running we simply abort. This is not an
   // error, however, as the instrumented module can still run.
   if (!coverage->session_.IsTracing()) {
@@ -178,6 +223,25 @@ void WINAPI Coverage::EntryHook(EntryHookFrame* entry_frame) {
     return;
   }
 
+  // The processes loading this module may share a single bitmap, which each
+  // of them writes to its trace.
+  if (entry_frame->coverage_data->data_type ==
+          IndexedFrequencyData::COVERAGE &&
+      coverage->MapSharedBitmap(module, entry_frame->coverage_data)) {
+    LOG(INFO) << "Coverage client initialized with a shared bitmap.";
+    return;
+  }
+
+  // The page coverage bitmap has an entry per page of the image, which the
+  // instrumentation leaves to us.
+  if (page_coverage) {
+    base::win::PEImage image(module);
+    size_t page_size = coverage->page_monitor_.page_size();
+    entry_frame->coverage_data->num_entries =
+        (image.GetNTHeaders()->OptionalHeader.SizeOfImage + page_size - 1) /
+            page_size;
+  }
+
   // Initialize the coverage data for this module.
   if (!coverage->InitializeCoverageData(module_base,
                                         entry_frame->coverage_data)) {
@@ -185,6 +249,12 @@ void WINAPI Coverage::EntryHook(EntryHookFrame* entry_frame) {
     return;
   }
 
+  if (page_coverage &&
+      !coverage->MonitorCodePages(module, entry_frame->coverage_data)) {
+    LOG(ERROR) << "Failed to monitor the code pages of the module.";
+    return;
+  }
+
   LOG(INFO) << "Coverage client initialized.";
 }
 
@@ -193,11 +263,7 @@ bool Coverage::InitializeCoverageData(void* module_base,
   DCHECK(coverage_data != NULL);
 
   // We can only handle this if it looks right.
-  if (coverage_data->agent_id != kBasicBlockCoverageAgentId ||
-      coverage_data->version != kBasicBlockFrequencyDataVersion ||
-      coverage_data->frequency_size != 1U ||
-      coverage_data->num_columns != 1U ||
-      coverage_data->data_type != IndexedFrequencyData::COVERAGE) {
+  if (!CoverageDataIsValid(coverage_data)) {
     LOG(ERROR) << "Unexpected values in the coverage data structures.";
     return false;
   }
@@ -209,9 +275,34 @@ bool Coverage::InitializeCoverageData(void* module_base,
     return true;
   }
 
+  TraceIndexedFrequencyData* trace_coverage_data =
+      AllocateCoverageRecord(coverage_data->num_entries);
+  if (trace_coverage_data == NULL)
+    return false;
+
+  // Initialize the coverage data struct.
+  base::win::PEImage image(module_base);
+  trace_coverage_data->data_type = coverage_data->data_type;
+  const IMAGE_NT_HEADERS* nt_headers = image.GetNTHeaders();
+  trace_coverage_data->module_base_addr =
+      reinterpret_cast<ModuleAddr>(image.module());
+  trace_coverage_data->module_base_size =
+      nt_headers->OptionalHeader.SizeOfImage;
+  trace_coverage_data->module_checksum = nt_headers->OptionalHeader.CheckSum;
+  trace_coverage_data->module_time_date_stamp =
+      nt_headers->FileHeader.TimeDateStamp;
+
+  // Hook up the newly allocated buffer to the call-trace instrumentation.
+  coverage_data->frequency_data =
+      trace_coverage_data->frequency_data;
+
+  return true;
+}
+
+TraceIndexedFrequencyData* Coverage::AllocateCoverageRecord(
+    size_t num_entries) {
   // Determine the size of the basic block frequency struct.
-  size_t bb_freq_size = sizeof(TraceIndexedFrequencyData) +
-      coverage_data->num_entries * coverage_data->frequency_size - 1;
+  size_t bb_freq_size = sizeof(TraceIndexedFrequencyData) + num_entries - 1;
 
   // Determine the size of the buffer we need. We need room for the basic block
   // frequency struct plus a single RecordPrefix header.
@@ -221,14 +312,14 @@ bool Coverage::InitializeCoverageData(void* module_base,
   trace::client::TraceFileSegment coverage_segment;
   if (!session_.AllocateBuffer(segment_size, &coverage_segment)) {
     LOG(ERROR) << "Failed to allocate coverage data segment.";
-    return false;
+    return NULL;
   }
 
   // Ensure it's big enough to allocation the basic-block frequency data
   // we want. This automatically accounts for the RecordPrefix overhead.
   if (!coverage_segment.CanAllocate(bb_freq_size)) {
     LOG(ERROR) << "Returned coverage data segment smaller than expected.";
-    return false;
+    return NULL;
   }
 
   // Allocate the basic-block frequency data. We will leave this allocated and
@@ -240,27 +331,237 @@ bool Coverage::InitializeCoverageData(void* module_base,
               bb_freq_size));
   DCHECK(trace_coverage_data != NULL);
 
-  // Initialize the coverage data struct.
-  base::win::PEImage image(module_base);
-  trace_coverage_data->data_type = coverage_data->data_type;
-  const IMAGE_NT_HEADERS* nt_headers = image.GetNTHeaders();
-  trace_coverage_data->module_base_addr =
-      reinterpret_cast<ModuleAddr>(image.module());
-  trace_coverage_data->module_base_size =
-      nt_headers->OptionalHeader.SizeOfImage;
-  trace_coverage_data->module_checksum = nt_headers->OptionalHeader.CheckSum;
-  trace_coverage_data->module_time_date_stamp =
-      nt_headers->FileHeader.TimeDateStamp;
   trace_coverage_data->frequency_size = 1;
   trace_coverage_data->num_columns = 1;
-  trace_coverage_data->num_entries = coverage_data->num_entries;
+  trace_coverage_data->num_entries = num_entries;
 
-  // Hook up the newly allocated buffer to the call-trace instrumentation.
-  coverage_data->frequency_data =
-      trace_coverage_data->frequency_data;
+  return trace_coverage_data;
+}
+
+bool Coverage::InitializeLiveCoverageData(
+    HMODULE module, IndexedFrequencyData* coverage_data) {
+  DCHECK(module != NULL);
+  DCHECK(coverage_data != NULL);
+
+  if (!CoverageDataIsValid(coverage_data) || coverage_data->num_entries == 0)
+    return false;
+
+  ::common::LiveFrequencyData* live_data =
+      agent::common::CreateLiveFrequencyData(module, *coverage_data);
+  if (live_data == NULL)
+    return false;
+  live_data_.push_back(live_data);
+
+  coverage_data->frequency_data = live_data->frequency_data();
+
+  return true;
+}
+
+bool Coverage::MapEdgeBitmap(IndexedFrequencyData* coverage_data) {
+  DCHECK(coverage_data != NULL);
+  DCHECK_EQ(IndexedFrequencyData::EDGE_COVERAGE, coverage_data->data_type);
+
+  if (!CoverageDataIsValid(coverage_data)) {
+    LOG(ERROR) << "Unexpected values in the edge coverage data structures.";
+    return false;
+  }
+
+  // The first entry to this is under the loader lock, as are all subsequent
+  // ones, so the mapping doesn't need any further protection.
+  if (edge_bitmap_ == NULL) {
+    scoped_ptr<base::Environment> env(base::Environment::Create());
+    std::string mapping_name;
+    if (env.get() == NULL || !env->GetVar(kEdgeBitmapEnvVar, &mapping_name))
+      return false;
+
+    edge_bitmap_mapping_.Set(::OpenFileMappingA(FILE_MAP_WRITE, FALSE,
+                                                mapping_name.c_str()));
+    if (!edge_bitmap_mapping_.IsValid()) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to open edge bitmap mapping \"" << mapping_name
+                 << "\": " << com::LogWe(error) << ".";
+      return false;
+    }
+
+    void* view = ::MapViewOfFile(edge_bitmap_mapping_.Get(), FILE_MAP_WRITE,
+                                 0, 0, 0);
+    if (view == NULL) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to map edge bitmap \"" << mapping_name << "\": "
+                 << com::LogWe(error) << ".";
+      edge_bitmap_mapping_.Close();
+      return false;
+    }
+
+    MEMORY_BASIC_INFORMATION info = {};
+    if (::VirtualQuery(view, &info, sizeof(info)) == 0) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "VirtualQuery failed: " << com::LogWe(error) << ".";
+      ::UnmapViewOfFile(view);
+      edge_bitmap_mapping_.Close();
+      return false;
+    }
+
+    edge_bitmap_ = reinterpret_cast<uint8*>(view);
+    edge_bitmap_size_ = info.RegionSize;
+  }
+
+  // The instrumentation indexes the bitmap directly, so it must cover every
+  // location the transform can generate.
+  if (edge_bitmap_size_ < coverage_data->num_entries) {
+    LOG(ERROR) << "Edge bitmap is too small (" << edge_bitmap_size_
+               << " bytes, need " << coverage_data->num_entries << ").";
+    return false;
+  }
+
+  coverage_data->frequency_data = edge_bitmap_;
 
   return true;
 }
 
+bool Coverage::MapSharedBitmap(HMODULE module,
+                               IndexedFrequencyData* coverage_data) {
+  DCHECK(module != NULL);
+  DCHECK(coverage_data != NULL);
+  DCHECK_EQ(IndexedFrequencyData::COVERAGE, coverage_data->data_type);
+
+  if (!CoverageDataIsValid(coverage_data) || coverage_data->num_entries == 0)
+    return false;
+
+  scoped_ptr<base::Environment> env(base::Environment::Create());
+  std::string prefix;
+  if (env.get() == NULL || !env->GetVar(kSharedBitmapEnvVar, &prefix) ||
+      prefix.empty()) {
+    return false;
+  }
+
+  base::win::PEImage image(module);
+  const IMAGE_NT_HEADERS* nt_headers = image.GetNTHeaders();
+  uint32 module_base_size = nt_headers->OptionalHeader.SizeOfImage;
+  uint32 module_checksum = nt_headers->OptionalHeader.CheckSum;
+  uint32 module_time_date_stamp = nt_headers->FileHeader.TimeDateStamp;
+  std::string name = base::StringPrintf("%s-%08X-%08X-%08X",
+                                        prefix.c_str(),
+                                        module_checksum,
+                                        module_time_date_stamp,
+                                        module_base_size);
+
+  // This either creates the bitmap, zeroed, or opens the one created by
+  // another process.
+  size_t mapping_size =
+      sizeof(SharedBitmapHeader) + coverage_data->num_entries;
+  base::win::ScopedHandle mapping(::CreateFileMappingA(
+      INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, mapping_size,
+      name.c_str()));
+  if (!mapping.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to create shared bitmap \"" << name << "\": "
+               << com::LogWe(error) << ".";
+    return false;
+  }
+
+  SharedBitmapHeader* header = reinterpret_cast<SharedBitmapHeader*>(
+      ::MapViewOfFile(mapping.Get(), FILE_MAP_WRITE, 0, 0, mapping_size));
+  if (header == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to map shared bitmap \"" << name << "\": "
+               << com::LogWe(error) << ".";
+    return false;
+  }
+
+  // Every process writes the same values, so this needn't be synchronized
+  // with the process that created the bitmap.
+  if (header->num_entries != 0 &&
+      header->num_entries != coverage_data->num_entries) {
+    LOG(ERROR) << "Shared bitmap \"" << name << "\" has "
+               << header->num_entries << " entries, expected "
+               << coverage_data->num_entries << ".";
+    ::UnmapViewOfFile(header);
+    return false;
+  }
+  header->module_base_size = module_base_size;
+  header->module_checksum = module_checksum;
+  header->module_time_date_stamp = module_time_date_stamp;
+  header->num_entries = coverage_data->num_entries;
+
+  SharedBitmap shared_bitmap = {
+      mapping.Take(), header, reinterpret_cast<ModuleAddr>(module) };
+  shared_bitmaps_.push_back(shared_bitmap);
+
+  coverage_data->frequency_data = header + 1;
+
+  return true;
+}
+
+void Coverage::ReleaseSharedBitmaps() {
+  for (size_t i = 0; i < shared_bitmaps_.size(); ++i) {
+    const SharedBitmap& shared_bitmap = shared_bitmaps_[i];
+    SharedBitmapHeader* header = shared_bitmap.header;
+
+    // Every process writes the bitmap as it stands, which includes the
+    // coverage of the processes sharing it so far. Relying on the last
+    // process out alone would lose all of it if that process crashed.
+    if (session_.IsTracing()) {
+      TraceIndexedFrequencyData* trace_coverage_data =
+          AllocateCoverageRecord(header->num_entries);
+      if (trace_coverage_data != NULL) {
+        trace_coverage_data->data_type = IndexedFrequencyData::COVERAGE;
+        trace_coverage_data->module_base_addr = shared_bitmap.module_base_addr;
+        trace_coverage_data->module_base_size = header->module_base_size;
+        trace_coverage_data->module_checksum = header->module_checksum;
+        trace_coverage_data->module_time_date_stamp =
+            header->module_time_date_stamp;
+        ::memcpy(trace_coverage_data->frequency_data, header + 1,
+                 header->num_entries);
+      }
+    }
+
+    ::UnmapViewOfFile(header);
+    ::CloseHandle(shared_bitmap.mapping);
+  }
+  shared_bitmaps_.clear();
+}
+
+bool Coverage::MonitorCodePages(HMODULE module,
+                                IndexedFrequencyData* coverage_data) {
+  DCHECK(module != NULL);
+  DCHECK(coverage_data != NULL);
+  DCHECK_EQ(IndexedFrequencyData::PAGE_COVERAGE, coverage_data->data_type);
+
+  PageCoverageModule page_coverage_module = {
+      reinterpret_cast<const uint8*>(module),
+      coverage_data->num_entries * page_monitor_.page_size(),
+      static_cast<uint8*>(coverage_data->frequency_data) };
+
+  // The guards are set once the loader is done relocating the module, so that
+  // it doesn't trip them. Reads of the code pages, such as of jump tables,
+  // are recorded as executions.
+  if (!page_monitor_.MonitorModuleCode(module))
+    return false;
+  page_coverage_modules_.push_back(page_coverage_module);
+
+  return true;
+}
+
+void Coverage::RecordPageCoverage() {
+  if (page_coverage_modules_.empty())
+    return;
+
+  page_monitor_.StopMonitoring();
+  agent::common::DataPageMonitor::PageVector pages;
+  page_monitor_.GetTouchedPages(&pages);
+  size_t page_size = page_monitor_.page_size();
+
+  for (size_t i = 0; i < page_coverage_modules_.size(); ++i) {
+    const PageCoverageModule& module = page_coverage_modules_[i];
+    for (size_t j = 0; j < pages.size(); ++j) {
+      const uint8* page = reinterpret_cast<const uint8*>(pages[j]);
+      if (page >= module.base && page < module.base + module.size)
+        module.bitmap[(page - module.base) / page_size] = 1;
+    }
+  }
+  page_coverage_modules_.clear();
+}
+
 }  // namespace coverage
 }  // namespace agent
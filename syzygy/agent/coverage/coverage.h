@@ -17,6 +17,17 @@
 // instrumentation will dump its code coverage results. The instrumentation
 // injects a run-time dependency on this library and adds appropriate
 // initialization hooks.
+//
+// Modules instrumented for page coverage carry no basic-block instrumentation.
+// Instead, their code pages are guarded when they are initialized, and the
+// pages that get executed are written to their coverage bitmap on tear-down.
+//
+// The processes that load the same module instrumented for basic-block
+// coverage may share a single bitmap for it (see kSharedBitmapEnvVar). As the
+// instrumentation only ever sets entries, the bitmap holds the union of their
+// coverage. Each process writes the bitmap to its trace when it tears down,
+// so the coverage of a process that crashes is still recorded by the processes
+// that outlive it.
 
 #ifndef SYZYGY_AGENT_COVERAGE_COVERAGE_H_
 #define SYZYGY_AGENT_COVERAGE_COVERAGE_H_
@@ -26,9 +37,13 @@
 #include <vector>
 
 #include "base/lazy_instance.h"
+#include "base/memory/scoped_vector.h"
 #include "base/win/pe_image.h"
+#include "base/win/scoped_handle.h"
+#include "syzygy/agent/common/data_page_monitor.h"
 #include "syzygy/agent/common/entry_frame.h"
 #include "syzygy/common/indexed_frequency_data.h"
+#include "syzygy/common/live_frequency_data.h"
 #include "syzygy/trace/client/rpc_session.h"
 
 // Instrumentation stubs to handle the loading of the library.
@@ -54,6 +69,33 @@ class Coverage {
   // Retrieves the coverage singleton instance.
   static Coverage* Instance();
 
+  // The name of the environment variable holding the name of a file mapping
+  // to use as the edge coverage bitmap. When it is set, modules instrumented
+  // for edge coverage update that shared memory directly and no trace data is
+  // produced for them. This allows an external process to read (and reset)
+  // the bitmap while the instrumented process is running.
+  static const char kEdgeBitmapEnvVar[];
+
+  // The name of the environment variable holding the prefix of the shared
+  // coverage bitmaps. When it is set, the processes that load a module
+  // instrumented for basic-block coverage share a bitmap named
+  // "<prefix>-<checksum>-<time date stamp>-<image size>" after the module's
+  // signature, each value being formatted as 8 hexadecimal digits. Each of
+  // these processes writes the bitmap, as it stands, to its trace when it
+  // tears down.
+  static const char kSharedBitmapEnvVar[];
+
+  // The header of a shared coverage bitmap, which is directly followed by the
+  // bitmap itself.
+  struct SharedBitmapHeader {
+    // The signature of the module the bitmap belongs to.
+    uint32 module_base_size;
+    uint32 module_checksum;
+    uint32 module_time_date_stamp;
+    // The number of entries in the bitmap.
+    uint32 num_entries;
+  };
+
  private:
   // Make sure the LazyInstance can be created.
   friend struct base::DefaultLazyInstanceTraits<Coverage>;
@@ -65,6 +107,68 @@ class Coverage {
   bool InitializeCoverageData(void* module_base,
                               ::common::IndexedFrequencyData* coverage_data);
 
+  // Allocates a coverage record in a segment of its own, which is left to be
+  // flushed when the call trace client is torn down.
+  // @param num_entries The number of entries of the record.
+  // @returns the record, with its module information left for the caller to
+  //     fill in, or NULL on failure.
+  TraceIndexedFrequencyData* AllocateCoverageRecord(size_t num_entries);
+
+  // Points the given coverage data element to a live frequency data section,
+  // if these are requested.
+  // @param module The instrumented module.
+  // @param coverage_data The coverage data element of @p module.
+  // @returns true if the data element now refers to a live section, false
+  //     otherwise.
+  bool InitializeLiveCoverageData(
+      HMODULE module, ::common::IndexedFrequencyData* coverage_data);
+
+  // Points the given edge coverage data element at the shared memory bitmap
+  // named by kEdgeBitmapEnvVar, mapping it in on first use.
+  // @param coverage_data The edge coverage data element to redirect.
+  // @returns true if the data element now refers to the shared bitmap, false
+  //     if the environment variable is not set or the mapping failed.
+  bool MapEdgeBitmap(::common::IndexedFrequencyData* coverage_data);
+
+  // Points the given coverage data element at the bitmap shared by all the
+  // processes that load the same module, creating the bitmap if need be.
+  // @param module The instrumented module.
+  // @param coverage_data The coverage data element of @p module.
+  // @returns true if the data element now refers to the shared bitmap, false
+  //     if kSharedBitmapEnvVar is not set or the bitmap can't be used.
+  bool MapSharedBitmap(HMODULE module,
+                       ::common::IndexedFrequencyData* coverage_data);
+
+  // Writes the shared bitmaps to the trace, and detaches from them.
+  void ReleaseSharedBitmaps();
+
+  // Starts recording the code pages of a module that get executed.
+  // @param module The instrumented module.
+  // @param coverage_data The page coverage data element of @p module, which
+  //     must already refer to a bitmap with an entry per page of the image.
+  // @returns true on success, false otherwise.
+  bool MonitorCodePages(HMODULE module,
+                        ::common::IndexedFrequencyData* coverage_data);
+
+  // Stops monitoring the code pages, and marks the pages that were executed
+  // in the page coverage bitmaps.
+  void RecordPageCoverage();
+
+  // Describes a shared bitmap this process uses.
+  struct SharedBitmap {
+    HANDLE mapping;
+    SharedBitmapHeader* header;
+    // The address of the module in this process.
+    ModuleAddr module_base_addr;
+  };
+
+  // Describes a module instrumented for page coverage.
+  struct PageCoverageModule {
+    const uint8* base;
+    size_t size;
+    uint8* bitmap;
+  };
+
   // The RPC session we're logging to/through.
   trace::client::RpcSession session_;
 
@@ -72,6 +176,27 @@ class Coverage {
   // goes to specially allocated segments that we don't explicitly keep track
   // of, but rather that we let live until the client gets torn down.
   trace::client::TraceFileSegment segment_;
+
+  // The shared edge coverage bitmap, and its size in bytes. These are only
+  // set if kEdgeBitmapEnvVar names a valid file mapping. All modules
+  // instrumented for edge coverage share this bitmap.
+  base::win::ScopedHandle edge_bitmap_mapping_;
+  uint8* edge_bitmap_;
+  size_t edge_bitmap_size_;
+
+  // The live frequency data sections of the instrumented modules, if any.
+  // These are only touched under the loader lock.
+  ScopedVector< ::common::LiveFrequencyData> live_data_;
+
+  // The shared bitmaps of the instrumented modules, if any. These are only
+  // touched under the loader lock.
+  std::vector<SharedBitmap> shared_bitmaps_;
+
+  // Records the first execution of the code pages of the modules instrumented
+  // for page coverage, and the modules themselves. These are only touched
+  // under the loader lock.
+  agent::common::DataPageMonitor page_monitor_;
+  std::vector<PageCoverageModule> page_coverage_modules_;
 };
 
 }  // namespace coverage
@@ -16,8 +16,13 @@
 
 #include "syzygy/agent/coverage/coverage.h"
 
+#include "base/environment.h"
 #include "base/file_util.h"
 #include "base/files/scoped_temp_dir.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/stringprintf.h"
+#include "base/win/pe_image.h"
+#include "base/win/scoped_handle.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/common/indexed_frequency_data.h"
@@ -69,10 +74,23 @@ MATCHER_P3(CoverageDataMatches, module, bb_count, bb_freqs, "") {
   return ::memcmp(bb_freqs, arg->frequency_data, bb_count) == 0;
 }
 
+MATCHER_P2(PageCoverageMatches, module, executed_page, "") {
+  if (arg->module_base_addr != module ||
+      arg->data_type != IndexedFrequencyData::PAGE_COVERAGE ||
+      arg->frequency_size != 1 ||
+      arg->num_entries <= executed_page) {
+    return false;
+  }
+
+  return arg->frequency_data[executed_page] == 1;
+}
+
 class CoverageClientTest : public testing::Test {
  public:
   CoverageClientTest()
-      : module_(NULL) {
+      : shared_bitmap_header_(NULL),
+        shared_bitmap_(NULL),
+        module_(NULL) {
   }
 
   virtual void SetUp() OVERRIDE {
@@ -150,6 +168,53 @@ class CoverageClientTest : public testing::Test {
     }
   }
 
+  // Creates the shared bitmap of this module, standing in for another process
+  // that uses it and has visited its second basic block.
+  void CreateSharedBitmap() {
+    // The agent isn't linked into this unittest so its copy of the variable
+    // name isn't available.
+    static const char kSharedBitmapEnvVar[] = "SYZYGY_COVERAGE_SHARED_BITMAP";
+    static const char kPrefix[] = "CoverageClientTestSharedBitmap";
+
+    base::win::PEImage image(::GetModuleHandle(NULL));
+    const IMAGE_NT_HEADERS* nt_headers = image.GetNTHeaders();
+    std::string name = base::StringPrintf(
+        "%s-%08X-%08X-%08X",
+        kPrefix,
+        nt_headers->OptionalHeader.CheckSum,
+        nt_headers->FileHeader.TimeDateStamp,
+        nt_headers->OptionalHeader.SizeOfImage);
+
+    const size_t kMappingSize =
+        sizeof(Coverage::SharedBitmapHeader) + kBasicBlockCount;
+    shared_bitmap_mapping_.Set(::CreateFileMappingA(
+        INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, kMappingSize,
+        name.c_str()));
+    ASSERT_TRUE(shared_bitmap_mapping_.IsValid());
+    shared_bitmap_header_ = reinterpret_cast<Coverage::SharedBitmapHeader*>(
+        ::MapViewOfFile(shared_bitmap_mapping_.Get(), FILE_MAP_ALL_ACCESS, 0,
+                        0, kMappingSize));
+    ASSERT_TRUE(shared_bitmap_header_ != NULL);
+    shared_bitmap_ = reinterpret_cast<uint8*>(shared_bitmap_header_ + 1);
+
+    shared_bitmap_[1] = 1;
+
+    scoped_ptr<base::Environment> env(base::Environment::Create());
+    ASSERT_TRUE(env.get() != NULL);
+    ASSERT_TRUE(env->SetVar(kSharedBitmapEnvVar, kPrefix));
+  }
+
+  void ReleaseSharedBitmap() {
+    scoped_ptr<base::Environment> env(base::Environment::Create());
+    ASSERT_TRUE(env.get() != NULL);
+    env->UnSetVar("SYZYGY_COVERAGE_SHARED_BITMAP");
+
+    ASSERT_TRUE(::UnmapViewOfFile(shared_bitmap_header_));
+    shared_bitmap_header_ = NULL;
+    shared_bitmap_ = NULL;
+    shared_bitmap_mapping_.Close();
+  }
+
   static BOOL WINAPI IndirectDllMain(HMODULE module,
                                      DWORD reason,
                                      LPVOID reserved);
@@ -167,6 +232,11 @@ class CoverageClientTest : public testing::Test {
   // Our call trace service process instance.
   testing::CallTraceService service_;
 
+  // The shared bitmap created by CreateSharedBitmap, and its header.
+  base::win::ScopedHandle shared_bitmap_mapping_;
+  Coverage::SharedBitmapHeader* shared_bitmap_header_;
+  uint8* shared_bitmap_;
+
  private:
   HMODULE module_;
   static FARPROC _indirect_penter_dllmain_;
@@ -260,5 +330,126 @@ TEST_F(CoverageClientTest, VisitOneBB) {
   ASSERT_NO_FATAL_FAILURE(ReplayLogs(1));
 }
 
+TEST_F(CoverageClientTest, PageCoverage) {
+  ASSERT_NO_FATAL_FAILURE(StartService());
+  ASSERT_NO_FATAL_FAILURE(LoadDll());
+
+  HMODULE self = ::GetModuleHandle(NULL);
+  DWORD process_id = ::GetCurrentProcessId();
+  DWORD thread_id = ::GetCurrentThreadId();
+
+  coverage_data.data_type = IndexedFrequencyData::PAGE_COVERAGE;
+  coverage_data.num_entries = 1;
+
+  // The entry thunk runs the hook, which guards the code pages of this
+  // module, then executes IndirectDllMain.
+  EXPECT_TRUE(DllMainThunk(self, DLL_PROCESS_ATTACH, NULL));
+  EXPECT_NE(static_cast<void*>(bb_seen_array), coverage_data.frequency_data);
+
+  // The bitmap is filled in when the agent is torn down.
+  ASSERT_NO_FATAL_FAILURE(UnloadDll());
+  coverage_data.data_type = IndexedFrequencyData::COVERAGE;
+  coverage_data.num_entries = kBasicBlockCount;
+
+  SYSTEM_INFO system_info = {};
+  ::GetSystemInfo(&system_info);
+  size_t executed_page =
+      (reinterpret_cast<const uint8*>(&IndirectDllMain) -
+          reinterpret_cast<const uint8*>(self)) / system_info.dwPageSize;
+
+  EXPECT_CALL(handler_, OnProcessStarted(_, process_id, _));
+  EXPECT_CALL(handler_, OnProcessAttach(_,
+                                        process_id,
+                                        thread_id,
+                                        ModuleAtAddress(self)));
+  EXPECT_CALL(handler_, OnIndexedFrequency(
+      _,
+      process_id,
+      thread_id,
+      PageCoverageMatches(self, executed_page)));
+  EXPECT_CALL(handler_, OnProcessEnded(_, process_id));
+
+  ASSERT_NO_FATAL_FAILURE(ReplayLogs(1));
+}
+
+TEST_F(CoverageClientTest, EdgeCoverageSharedBitmap) {
+  // The mapping the agent should attach to. The agent isn't linked into this
+  // unittest so its copy of the variable name isn't available.
+  static const char kEdgeBitmapEnvVar[] = "SYZYGY_COVERAGE_EDGE_BITMAP";
+  static const char kMappingName[] = "CoverageClientTestEdgeBitmap";
+  base::win::ScopedHandle mapping(::CreateFileMappingA(
+      INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+      ::common::kEdgeCoverageBitmapSize, kMappingName));
+  ASSERT_TRUE(mapping.IsValid());
+  uint8* bitmap = reinterpret_cast<uint8*>(
+      ::MapViewOfFile(mapping.Get(), FILE_MAP_ALL_ACCESS, 0, 0, 0));
+  ASSERT_TRUE(bitmap != NULL);
+
+  scoped_ptr<base::Environment> env(base::Environment::Create());
+  ASSERT_TRUE(env.get() != NULL);
+  ASSERT_TRUE(env->SetVar(kEdgeBitmapEnvVar, kMappingName));
+
+  coverage_data.data_type = IndexedFrequencyData::EDGE_COVERAGE;
+  coverage_data.num_entries = ::common::kEdgeCoverageBitmapSize;
+
+  ASSERT_NO_FATAL_FAILURE(LoadDll());
+  EXPECT_TRUE(DllMainThunk(::GetModuleHandle(NULL), DLL_PROCESS_ATTACH, NULL));
+
+  // The data should have been redirected to the shared bitmap, even though
+  // there is no call trace service running.
+  EXPECT_NE(static_cast<void*>(bb_seen_array), coverage_data.frequency_data);
+  VisitBlock(1234);
+  EXPECT_EQ(1U, bitmap[1234]);
+
+  ASSERT_NO_FATAL_FAILURE(UnloadDll());
+
+  coverage_data.data_type = IndexedFrequencyData::COVERAGE;
+  coverage_data.num_entries = kBasicBlockCount;
+  env->UnSetVar(kEdgeBitmapEnvVar);
+  ::UnmapViewOfFile(bitmap);
+
+  // No trace file should have been produced.
+  ASSERT_NO_FATAL_FAILURE(ReplayLogs(0));
+}
+
+TEST_F(CoverageClientTest, SharedBitmapIsWrittenWhileShared) {
+  ASSERT_NO_FATAL_FAILURE(CreateSharedBitmap());
+  ASSERT_NO_FATAL_FAILURE(StartService());
+  ASSERT_NO_FATAL_FAILURE(LoadDll());
+
+  HMODULE self = ::GetModuleHandle(NULL);
+  DWORD process_id = ::GetCurrentProcessId();
+  DWORD thread_id = ::GetCurrentThreadId();
+
+  EXPECT_TRUE(DllMainThunk(self, DLL_PROCESS_ATTACH, NULL));
+  EXPECT_NE(static_cast<void*>(bb_seen_array), coverage_data.frequency_data);
+  EXPECT_EQ(kBasicBlockCount, shared_bitmap_header_->num_entries);
+
+  // The coverage of both processes ends up in the shared bitmap.
+  VisitBlock(0);
+  EXPECT_EQ(1U, shared_bitmap_[0]);
+  EXPECT_EQ(1U, shared_bitmap_[1]);
+
+  // The other process is still using the bitmap, and may never tear down.
+  // This one writes the coverage of both anyway.
+  ASSERT_NO_FATAL_FAILURE(UnloadDll());
+  ASSERT_NO_FATAL_FAILURE(ReleaseSharedBitmap());
+
+  const uint8 kExpectedCoverageData[kBasicBlockCount] = { 1, 1 };
+  EXPECT_CALL(handler_, OnProcessStarted(_, process_id, _));
+  EXPECT_CALL(handler_, OnProcessAttach(_,
+                                        process_id,
+                                        thread_id,
+                                        ModuleAtAddress(self)));
+  EXPECT_CALL(handler_, OnIndexedFrequency(
+      _,
+      process_id,
+      thread_id,
+      CoverageDataMatches(self, kBasicBlockCount, kExpectedCoverageData)));
+  EXPECT_CALL(handler_, OnProcessEnded(_, process_id));
+
+  ASSERT_NO_FATAL_FAILURE(ReplayLogs(1));
+}
+
 }  // namespace coverage
 }  // namespace agent
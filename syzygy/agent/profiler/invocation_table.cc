@@ -0,0 +1,159 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/profiler/invocation_table.h"
+
+#include "base/logging.h"
+
+namespace agent {
+namespace profiler {
+
+InvocationTable::Entry::Entry()
+    : caller(NULL),
+      function(NULL),
+      caller_move_count(0),
+      caller_offset(0),
+      function_move_count(0),
+      num_calls(0),
+      cycles_min(0),
+      cycles_max(0),
+      cycles_sum(0) {
+}
+
+bool InvocationTable::Entry::IsValid() const {
+  return (caller_symbol == NULL ||
+          caller_symbol->move_count() == caller_move_count) &&
+      (function_symbol == NULL ||
+       function_symbol->move_count() == function_move_count);
+}
+
+void InvocationTable::Entry::ToInvocationInfo(InvocationInfo* info) const {
+  DCHECK(info != NULL);
+  DCHECK(in_use());
+
+  if (function_symbol == NULL) {
+    // We're not in a dynamic function, record the (conventional) function.
+    info->function = function;
+    info->flags = 0;
+  } else {
+    // We're in a dynamic function symbol, record the details.
+    DCHECK_NE(function_symbol->id(), 0);
+
+    info->function_symbol_id = function_symbol->id();
+    info->flags = kFunctionIsSymbol;
+  }
+
+  if (caller_symbol == NULL) {
+    // We're not in a dynamic caller_symbol, record the (conventional) caller.
+    info->caller = caller;
+    info->caller_offset = 0;
+  } else {
+    // We're in a dynamic caller_symbol, record the details.
+    DCHECK_NE(caller_symbol->id(), 0);
+
+    info->caller_symbol_id = caller_symbol->id();
+    info->flags |= kCallerIsSymbol;
+    info->caller_offset = caller_offset;
+  }
+
+  info->num_calls = num_calls;
+  info->cycles_min = cycles_min;
+  info->cycles_max = cycles_max;
+  info->cycles_sum = cycles_sum;
+}
+
+InvocationTable::InvocationTable(size_t num_slots)
+    : entries_(num_slots), num_entries_(0) {
+  DCHECK_LE(kMaxProbes, num_slots);
+  DCHECK_EQ(0u, num_slots & (num_slots - 1));
+}
+
+InvocationTable::Entry* InvocationTable::FindSlot(RetAddr caller,
+                                                  FuncAddr function) {
+  size_t mask = entries_.size() - 1;
+  size_t slot = HomeSlot(caller, function);
+  Entry* victim = NULL;
+  for (size_t i = 0; i < kMaxProbes; ++i, slot = (slot + 1) & mask) {
+    Entry* entry = &entries_[slot];
+
+    // As slots are never released individually, the first unused slot ends
+    // the probe sequence.
+    if (!entry->in_use() || entry->Matches(caller, function))
+      return entry;
+
+    if (victim == NULL || entry->num_calls < victim->num_calls)
+      victim = entry;
+  }
+
+  // The probe sequence is full, so evict its least called entry. This keeps
+  // the hot pairs in the table.
+  DCHECK(victim != NULL);
+  return victim;
+}
+
+void InvocationTable::Insert(Entry* slot,
+                             RetAddr caller,
+                             FuncAddr function,
+                             SymbolMap::Symbol* caller_symbol,
+                             SymbolMap::Symbol* function_symbol,
+                             uint64 cycles) {
+  DCHECK(slot >= &entries_.front() && slot <= &entries_.back());
+
+  if (!slot->in_use())
+    ++num_entries_;
+
+  slot->caller = caller;
+  slot->function = function;
+
+  slot->caller_symbol = caller_symbol;
+  if (caller_symbol != NULL) {
+    slot->caller_move_count = caller_symbol->move_count();
+    slot->caller_offset = reinterpret_cast<const uint8*>(caller) -
+        reinterpret_cast<const uint8*>(caller_symbol->address());
+  } else {
+    slot->caller_move_count = 0;
+    slot->caller_offset = 0;
+  }
+
+  slot->function_symbol = function_symbol;
+  if (function_symbol != NULL)
+    slot->function_move_count = function_symbol->move_count();
+  else
+    slot->function_move_count = 0;
+
+  slot->num_calls = 1;
+  slot->cycles_min = slot->cycles_max = slot->cycles_sum = cycles;
+}
+
+void InvocationTable::Clear() {
+  if (num_entries_ == 0)
+    return;
+
+  // Reset the slots in place, which also releases the symbol references.
+  for (size_t i = 0; i < entries_.size(); ++i)
+    entries_[i] = Entry();
+  num_entries_ = 0;
+}
+
+size_t InvocationTable::HomeSlot(RetAddr caller, FuncAddr function) const {
+  // Return addresses and function addresses tend to share their high bits,
+  // so mix them before folding the hash down to the table size.
+  size_t hash = reinterpret_cast<uintptr_t>(caller) * 0x9E3779B1 ^
+      reinterpret_cast<uintptr_t>(function);
+  hash ^= hash >> 16;
+  return hash & (entries_.size() - 1);
+}
+
+}  // namespace profiler
+}  // namespace agent
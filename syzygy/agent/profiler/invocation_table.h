@@ -0,0 +1,164 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares InvocationTable, a fixed-size open-addressed hash table that
+// aggregates the invocation statistics for each distinct caller/function pair
+// observed on a single thread. Entries are tallied in place, and are only
+// written to the trace when they're evicted to make room for a new pair, or
+// when the table is spilled in its entirety (e.g. on thread detach).
+
+#ifndef SYZYGY_AGENT_PROFILER_INVOCATION_TABLE_H_
+#define SYZYGY_AGENT_PROFILER_INVOCATION_TABLE_H_
+
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/memory/ref_counted.h"
+#include "syzygy/agent/profiler/symbol_map.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
+
+namespace agent {
+namespace profiler {
+
+// An open-addressed table of invocation statistics. Each table is owned and
+// used by a single thread, hence there is no locking whatsoever.
+class InvocationTable {
+ public:
+  // The statistics for a single caller/function pair.
+  struct Entry {
+    Entry();
+
+    // @returns true iff this entry holds a caller/function pair.
+    bool in_use() const { return num_calls != 0; }
+
+    // @returns true iff this entry holds @p other_caller and
+    //     @p other_function.
+    bool Matches(RetAddr other_caller, FuncAddr other_function) const {
+      return caller == other_caller && function == other_function &&
+          in_use();
+    }
+
+    // @returns true iff the dynamic symbols resolved for this entry, if any,
+    //     have not moved since.
+    bool IsValid() const;
+
+    // Tallies another invocation of the pair held in this entry.
+    // @param cycles the duration of the invocation.
+    void Tally(uint64 cycles) {
+      ++num_calls;
+      cycles_sum += cycles;
+      if (cycles < cycles_min) {
+        cycles_min = cycles;
+      } else if (cycles > cycles_max) {
+        cycles_max = cycles;
+      }
+    }
+
+    // Fills in the trace record for this entry.
+    // @param info the trace record to fill in.
+    void ToInvocationInfo(InvocationInfo* info) const;
+
+    // The caller and function for this entry.
+    RetAddr caller;
+    FuncAddr function;
+
+    // This entry's caller's dynamic symbol, if any.
+    scoped_refptr<SymbolMap::Symbol> caller_symbol;
+    // The last observed move count for caller_symbol.
+    int32 caller_move_count;
+    // The offset of caller relative to caller_symbol when last observed.
+    // This is captured up front, as the symbol may move before the entry is
+    // written to the trace.
+    uint32 caller_offset;
+
+    // This entry's callee's dynamic symbol, if any.
+    scoped_refptr<SymbolMap::Symbol> function_symbol;
+    // The last observed move count for function_symbol.
+    int32 function_move_count;
+
+    // The statistics tallied so far. An unused entry has no calls.
+    size_t num_calls;
+    uint64 cycles_min;
+    uint64 cycles_max;
+    uint64 cycles_sum;
+  };
+
+  typedef std::vector<Entry> EntryVector;
+  typedef EntryVector::iterator iterator;
+
+  // The default number of slots in a table.
+  static const size_t kDefaultNumSlots = 1024;
+  // The number of slots probed for a pair before an entry gets evicted.
+  static const size_t kMaxProbes = 8;
+
+  // @param num_slots the number of slots in the table, this must be a power
+  //     of two no smaller than kMaxProbes.
+  explicit InvocationTable(size_t num_slots);
+
+  // Finds the slot for a caller/function pair.
+  // @param caller the caller of the invocation.
+  // @param function the function invoked.
+  // @returns the entry holding @p caller and @p function if there is one.
+  //     Otherwise returns the slot to claim for them, which is either unused
+  //     or else is the least called entry on the pair's probe sequence. In the
+  //     latter case, the entry must be spilled by the caller before reuse.
+  Entry* FindSlot(RetAddr caller, FuncAddr function);
+
+  // Starts tallying a new caller/function pair in a slot returned by
+  // FindSlot. Any entry previously held in the slot is discarded.
+  // @param slot the slot to claim.
+  // @param caller the caller of the invocation.
+  // @param function the function invoked.
+  // @param caller_symbol the dynamic symbol covering @p caller, if any.
+  // @param function_symbol the dynamic symbol covering @p function, if any.
+  // @param cycles the duration of the invocation.
+  void Insert(Entry* slot,
+              RetAddr caller,
+              FuncAddr function,
+              SymbolMap::Symbol* caller_symbol,
+              SymbolMap::Symbol* function_symbol,
+              uint64 cycles);
+
+  // Releases all entries.
+  void Clear();
+
+  // @name Accessors.
+  // @{
+  size_t num_slots() const { return entries_.size(); }
+  size_t num_entries() const { return num_entries_; }
+  bool empty() const { return num_entries_ == 0; }
+  iterator begin() { return entries_.begin(); }
+  iterator end() { return entries_.end(); }
+  // @}
+
+ protected:
+  // @returns the home slot of the @p caller, @p function pair.
+  size_t HomeSlot(RetAddr caller, FuncAddr function) const;
+
+  // The slots of the table. The table is only ever cleared as a whole, which
+  // means there's never an unused slot on the probe sequence of a pair before
+  // the slot holding it.
+  EntryVector entries_;
+
+  // The number of slots in use.
+  size_t num_entries_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(InvocationTable);
+};
+
+}  // namespace profiler
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_PROFILER_INVOCATION_TABLE_H_
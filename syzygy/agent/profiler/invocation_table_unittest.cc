@@ -0,0 +1,164 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/profiler/invocation_table.h"
+
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace profiler {
+
+namespace {
+
+RetAddr ToRetAddr(uintptr_t number) {
+  return reinterpret_cast<RetAddr>(number);
+}
+
+FuncAddr ToFuncAddr(uintptr_t number) {
+  return reinterpret_cast<FuncAddr>(number);
+}
+
+class InvocationTableTest : public testing::Test {
+ public:
+  InvocationTableTest() : table_(InvocationTable::kMaxProbes) {
+  }
+
+  // Records an invocation the way the profiler does.
+  // @returns true iff an entry was spilled to make room for the invocation,
+  //     in which case it's written to @p spilled.
+  bool Record(RetAddr caller, FuncAddr function, uint64 cycles,
+              InvocationInfo* spilled) {
+    InvocationTable::Entry* entry = table_.FindSlot(caller, function);
+    EXPECT_TRUE(entry != NULL);
+    if (entry->Matches(caller, function) && entry->IsValid()) {
+      entry->Tally(cycles);
+      return false;
+    }
+
+    bool did_spill = false;
+    if (entry->in_use()) {
+      entry->ToInvocationInfo(spilled);
+      did_spill = true;
+    }
+    table_.Insert(entry, caller, function, NULL, NULL, cycles);
+    return did_spill;
+  }
+
+ protected:
+  InvocationTable table_;
+};
+
+}  // namespace
+
+TEST_F(InvocationTableTest, TalliesInPlace) {
+  const RetAddr kCaller = ToRetAddr(0x1000);
+  const FuncAddr kFunction = ToFuncAddr(0x2000);
+
+  InvocationInfo spilled = {};
+  EXPECT_FALSE(Record(kCaller, kFunction, 10, &spilled));
+  EXPECT_FALSE(Record(kCaller, kFunction, 5, &spilled));
+  EXPECT_FALSE(Record(kCaller, kFunction, 20, &spilled));
+  EXPECT_EQ(1u, table_.num_entries());
+
+  InvocationTable::Entry* entry = table_.FindSlot(kCaller, kFunction);
+  ASSERT_TRUE(entry->Matches(kCaller, kFunction));
+
+  InvocationInfo info = {};
+  entry->ToInvocationInfo(&info);
+  EXPECT_EQ(kCaller, info.caller);
+  EXPECT_EQ(kFunction, info.function);
+  EXPECT_EQ(0u, info.flags);
+  EXPECT_EQ(3u, info.num_calls);
+  EXPECT_EQ(5u, info.cycles_min);
+  EXPECT_EQ(20u, info.cycles_max);
+  EXPECT_EQ(35u, info.cycles_sum);
+}
+
+TEST_F(InvocationTableTest, EvictsLeastCalledEntry) {
+  const RetAddr kCaller = ToRetAddr(0x1000);
+
+  // Fill the table, calling each function as many times as its index.
+  InvocationInfo spilled = {};
+  for (size_t i = 0; i < table_.num_slots(); ++i) {
+    for (size_t j = 0; j <= i; ++j)
+      EXPECT_FALSE(Record(kCaller, ToFuncAddr(0x2000 + i), 1, &spilled));
+  }
+  EXPECT_EQ(table_.num_slots(), table_.num_entries());
+
+  // A new pair evicts the entry with a single call.
+  EXPECT_TRUE(Record(kCaller, ToFuncAddr(0x3000), 1, &spilled));
+  EXPECT_EQ(kCaller, spilled.caller);
+  EXPECT_EQ(ToFuncAddr(0x2000), spilled.function);
+  EXPECT_EQ(1u, spilled.num_calls);
+  EXPECT_EQ(table_.num_slots(), table_.num_entries());
+
+  // The hottest pair is still being tallied in place.
+  FuncAddr hottest = ToFuncAddr(0x2000 + table_.num_slots() - 1);
+  EXPECT_TRUE(table_.FindSlot(kCaller, hottest)->Matches(kCaller, hottest));
+}
+
+TEST_F(InvocationTableTest, Clear) {
+  InvocationInfo spilled = {};
+  EXPECT_FALSE(Record(ToRetAddr(0x1000), ToFuncAddr(0x2000), 1, &spilled));
+  EXPECT_FALSE(Record(ToRetAddr(0x1001), ToFuncAddr(0x2000), 1, &spilled));
+  EXPECT_EQ(2u, table_.num_entries());
+
+  table_.Clear();
+  EXPECT_TRUE(table_.empty());
+
+  InvocationTable::iterator it = table_.begin();
+  for (; it != table_.end(); ++it)
+    EXPECT_FALSE(it->in_use());
+}
+
+TEST_F(InvocationTableTest, DynamicSymbols) {
+  SymbolMap symbol_map;
+  const uint8* kCallerSymbolAddr = reinterpret_cast<const uint8*>(0x1000);
+  const uint8* kFunctionSymbolAddr = reinterpret_cast<const uint8*>(0x2000);
+  symbol_map.AddSymbol(kCallerSymbolAddr, 0x100, "caller");
+  symbol_map.AddSymbol(kFunctionSymbolAddr, 0x100, "function");
+
+  const RetAddr kCaller = kCallerSymbolAddr + 0x10;
+  const FuncAddr kFunction = kFunctionSymbolAddr;
+  scoped_refptr<SymbolMap::Symbol> caller_symbol =
+      symbol_map.FindSymbol(kCaller);
+  scoped_refptr<SymbolMap::Symbol> function_symbol =
+      symbol_map.FindSymbol(kFunction);
+  ASSERT_TRUE(caller_symbol != NULL);
+  ASSERT_TRUE(function_symbol != NULL);
+  caller_symbol->EnsureHasId();
+  function_symbol->EnsureHasId();
+
+  InvocationTable::Entry* entry = table_.FindSlot(kCaller, kFunction);
+  table_.Insert(entry, kCaller, kFunction, caller_symbol, function_symbol, 1);
+  EXPECT_TRUE(entry->IsValid());
+
+  // Moving the caller invalidates the entry, but it still reports the
+  // offset it was recorded at.
+  symbol_map.MoveSymbol(kCallerSymbolAddr, kCallerSymbolAddr + 0x1000);
+  EXPECT_FALSE(entry->IsValid());
+
+  InvocationInfo info = {};
+  entry->ToInvocationInfo(&info);
+  EXPECT_EQ(static_cast<uint32>(kCallerIsSymbol | kFunctionIsSymbol),
+            info.flags);
+  EXPECT_EQ(static_cast<uint32>(caller_symbol->id()), info.caller_symbol_id);
+  EXPECT_EQ(0x10u, info.caller_offset);
+  EXPECT_EQ(static_cast<uint32>(function_symbol->id()),
+            info.function_symbol_id);
+  EXPECT_EQ(1u, info.num_calls);
+}
+
+}  // namespace profiler
+}  // namespace agent
@@ -28,56 +28,25 @@
 #include "base/memory/scoped_ptr.h"
 #include "base/win/pe_image.h"
 #include "base/win/scoped_handle.h"
+#include "sawbuck/common/com_utils.h"
 #include "syzygy/agent/common/dlist.h"
 #include "syzygy/agent/common/process_utils.h"
 #include "syzygy/agent/common/scoped_last_error_keeper.h"
+#include "syzygy/agent/profiler/invocation_table.h"
 #include "syzygy/agent/profiler/return_thunk_factory.h"
+#include "syzygy/agent/profiler/shadow_stack.h"
 #include "syzygy/common/logging.h"
 #include "syzygy/trace/client/client_utils.h"
+#include "syzygy/trace/common/clock.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 
 namespace {
 
 using agent::common::ScopedLastErrorKeeper;
 
-typedef std::pair<RetAddr, FuncAddr> InvocationKey;
-
-class HashInvocationKey {
- public:
-  static const size_t bucket_size = 4;
-  static const size_t min_buckets = 8;
-
-  size_t operator()(const InvocationKey& key) const {
-    return reinterpret_cast<size_t>(key.first) ^
-        reinterpret_cast<size_t>(key.second);
-  }
-
-  bool operator()(const InvocationKey& a, const InvocationKey& b) const {
-    return a < b;
-  }
-};
-
+using agent::profiler::InvocationTable;
 using agent::profiler::SymbolMap;
 
-struct InvocationValue {
-  // This invocation entry's caller's dynamic symbol, if any.
-  scoped_refptr<SymbolMap::Symbol> caller_symbol;
-  // The last observed move count for caller_symbol.
-  int32 caller_move_count;
-
-  // This invocation entry's callee's dynamic symbol, if any.
-  scoped_refptr<SymbolMap::Symbol> function_symbol;
-  // The last observed move count for function_symbol.
-  int32 function_move_count;
-
-  // Points to the trace buffer entry for the respective function.
-  InvocationInfo* info;
-};
-
-typedef base::hash_map<
-    InvocationKey, InvocationValue, HashInvocationKey> InvocationMap;
-
-
 // The information on how to set the thread name comes from
 // a MSDN article: http://msdn2.microsoft.com/en-us/library/xcb2z8hs.aspx
 const DWORD kVCThreadNameException = 0x406D1388;
@@ -89,8 +58,69 @@ typedef struct tagTHREADNAME_INFO {
   DWORD dwFlags;  // Reserved for future use, must be zero.
 } THREADNAME_INFO;
 
+// The number of measurements each calibration step keeps the best of.
+const size_t kCalibrationRounds = 1000;
+const size_t kTscOffsetRounds = 16;
+
+// The number of cycles between the entry thunk's TSC read and the end of the
+// last calibration hook, which is what the profiler tallies as its overhead.
+uint64 calibration_tallied_cycles = 0;
+
+// Stands in for the profiler's entry hook during calibration. Like the
+// profiler, it accounts for the cycles it ran for.
+void WINAPI CalibrationEntryHook(agent::EntryFrame* entry_frame,
+                                 FuncAddr function,
+                                 uint64 cycles) {
+  ScopedLastErrorKeeper keep_last_error;
+  calibration_tallied_cycles = __rdtsc() - cycles;
+}
+
 }  // namespace
 
+// A copy of _indirect_penter that calls CalibrationEntryHook instead of the
+// profiler's entry hook.
+extern "C" void __declspec(naked) _calibration_penter() {
+  __asm {
+    push eax
+    push edx
+    rdtsc
+    push ecx
+    mov ecx, eax
+    lahf
+    seto al
+    push eax
+    push edx
+    push ecx
+    mov eax, DWORD PTR[esp + 0x18]
+    push eax
+    lea eax, DWORD PTR[esp + 0x20]
+    push eax
+    call CalibrationEntryHook
+    pop eax
+    add al, 0x7f
+    sahf
+    pop ecx
+    pop edx
+    pop eax
+    ret
+  }
+}
+
+// An empty function, and the thunk the instrumenter would redirect its calls
+// to.
+extern "C" void __declspec(naked) _calibration_function() {
+  __asm {
+    ret
+  }
+}
+
+extern "C" void __declspec(naked) _calibration_thunk() {
+  __asm {
+    push offset _calibration_function
+    jmp _calibration_penter
+  }
+}
+
 // See client.cc for a description of the unconventional
 // calling conventions for this function.
 extern "C" void __declspec(naked) _indirect_penter() {
@@ -199,6 +229,154 @@ extern "C" void __declspec(naked) _indirect_penter_dllmain() {
   }
 }
 
+// The entry hooks for modules instrumented with exit hooks. These have the same
+// calling conventions as _indirect_penter and _indirect_penter_dllmain.
+extern "C" void __declspec(naked) _indirect_penter_shadow() {
+  __asm {
+    // Stash volatile registers.
+    push eax
+    push edx
+
+    // Get the current cycle time ASAP.
+    rdtsc
+
+    // Save the value of eax for later, we need the register to stash the flags.
+    push ecx
+    mov ecx, eax
+
+    // Save the low byte of the flags into AH.
+    lahf
+    // Save the overflow flag into AL.
+    seto al
+
+    // Stash the flags to stack.
+    push eax
+
+    // Push the cycle time arg.
+    push edx
+    push ecx
+
+    // Retrieve the original function address, pushed by our caller.
+    mov eax, DWORD PTR[esp + 0x18]
+    push eax
+
+    // Calculate the position of the return address on stack, and
+    // push it. This becomes the EntryFrame argument.
+    lea eax, DWORD PTR[esp + 0x20]
+    push eax
+    call agent::profiler::Profiler::ShadowFunctionEntryHook
+
+    // Restore volatile registers.
+    pop eax
+    add al, 0x7f
+    sahf
+
+    pop ecx
+    pop edx
+    pop eax
+
+    // Return to the address pushed by our caller.
+    ret
+  }
+}
+
+extern "C" void __declspec(naked) _indirect_penter_shadow_dllmain() {
+  __asm {
+    // Stash volatile registers.
+    push eax
+    push edx
+
+    // Get the current cycle time ASAP.
+    rdtsc
+
+    // Save the value of eax for later, we need the register to stash the flags.
+    push ecx
+    mov ecx, eax
+
+    // Save the low byte of the flags into AH.
+    lahf
+    // Save the overflow flag into AL.
+    seto al
+
+    // Stash the flags to stack.
+    push eax
+
+    // Push the cycle time arg.
+    push edx
+    push ecx
+
+    // Retrieve the original function address, pushed by our caller.
+    mov eax, DWORD PTR[esp + 0x18]
+    push eax
+
+    // Calculate the position of the return address on stack, and
+    // push it. This becomes the EntryFrame argument.
+    lea eax, DWORD PTR[esp + 0x20]
+    push eax
+    call agent::profiler::Profiler::ShadowDllMainEntryHook
+
+    // Restore volatile registers.
+    pop eax
+    add al, 0x7f
+    sahf
+
+    pop ecx
+    pop edx
+    pop eax
+
+    // Return to the address pushed by our caller.
+    ret
+  }
+}
+
+// The exit hook, called by the instrumentation right before each return of an
+// instrumented function. This preserves EAX and EDX, which hold the return
+// value, as well as the flags.
+extern "C" void __declspec(naked) _indirect_pexit() {
+  __asm {
+    // Stash volatile registers.
+    push eax
+    push edx
+
+    // Get the current cycle time ASAP.
+    rdtsc
+
+    // Save the value of eax for later, we need the register to stash the flags.
+    push ecx
+    mov ecx, eax
+
+    // Save the low byte of the flags into AH.
+    lahf
+    // Save the overflow flag into AL.
+    seto al
+
+    // Stash the flags to stack.
+    push eax
+
+    // Push the cycle time arg.
+    push edx
+    push ecx
+
+    // Calculate the position of the exiting function's return address on
+    // stack, which is right above our own, and push it.
+    lea eax, DWORD PTR[esp + 0x1C]
+    push eax
+    call agent::profiler::Profiler::FunctionExitHook
+
+    // Restore volatile registers.
+    pop eax
+    add al, 0x7f
+    sahf
+
+    pop ecx
+    pop edx
+    pop eax
+
+    // Return to the exiting function.
+    ret
+  }
+}
+
 // On entry, pc_location should point to a location on our own stack.
 extern "C" uintptr_t __cdecl ResolveReturnAddressLocation(
     uintptr_t pc_location) {
@@ -279,6 +457,122 @@ void __cdecl MoveDynamicSymbol(const void* old_address,
 namespace agent {
 namespace profiler {
 
+namespace {
+
+// Measures the cycles an instrumented invocation spends in the
+// instrumentation, but outside of the window the profiler accounts for as its
+// overhead at runtime. These end up in the invocation's cycle count.
+// @param tsc_read_cycles returns the minimum cost of a TSC read.
+// @param invocation_overhead_cycles returns the unaccounted cycles.
+void MeasureInvocationOverhead(uint64* tsc_read_cycles,
+                               uint64* invocation_overhead_cycles) {
+  DCHECK(tsc_read_cycles != NULL);
+  DCHECK(invocation_overhead_cycles != NULL);
+
+  uint64 min_read_cycles = kuint64max;
+  for (size_t i = 0; i < kCalibrationRounds; ++i) {
+    uint64 start = __rdtsc();
+    uint64 end = __rdtsc();
+    min_read_cycles = std::min(min_read_cycles, end - start);
+  }
+
+  uint64 min_untallied_cycles = kuint64max;
+  for (size_t i = 0; i < kCalibrationRounds; ++i) {
+    uint64 start = __rdtsc();
+    _calibration_thunk();
+    uint64 end = __rdtsc();
+
+    uint64 total_cycles = end - start;
+    uint64 accounted_cycles = min_read_cycles + calibration_tallied_cycles;
+    if (total_cycles < accounted_cycles)
+      total_cycles = accounted_cycles;
+    min_untallied_cycles =
+        std::min(min_untallied_cycles, total_cycles - accounted_cycles);
+  }
+
+  // The return thunk saves and restores the same state as the entry thunk
+  // around its own hook, so an invocation pays this twice.
+  *tsc_read_cycles = min_read_cycles;
+  *invocation_overhead_cycles = 2 * min_untallied_cycles;
+}
+
+// Estimates the offset of the TSC of each processor this process may run on,
+// relative to the first one, by reading it along with the performance counter
+// on each processor in turn.
+// @param tsc_offsets returns the offsets, or nothing if they can't be
+//     estimated.
+void MeasureTscOffsets(std::vector<int64>* tsc_offsets) {
+  DCHECK(tsc_offsets != NULL);
+  tsc_offsets->clear();
+
+  trace::common::TimerInfo tsc_info = {};
+  trace::common::GetTscTimerInfo(&tsc_info);
+  LARGE_INTEGER qpc_frequency = {};
+  if (tsc_info.frequency == 0 ||
+      !::QueryPerformanceFrequency(&qpc_frequency) ||
+      qpc_frequency.QuadPart == 0) {
+    LOG(WARNING) << "Unable to estimate the TSC offsets.";
+    return;
+  }
+  double tsc_per_qpc = static_cast<double>(tsc_info.frequency) /
+      static_cast<double>(qpc_frequency.QuadPart);
+
+  DWORD_PTR process_mask = 0;
+  DWORD_PTR system_mask = 0;
+  if (!::GetProcessAffinityMask(::GetCurrentProcess(), &process_mask,
+                                &system_mask)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "GetProcessAffinityMask failed: " << com::LogWe(error)
+               << ".";
+    return;
+  }
+
+  HANDLE thread = ::GetCurrentThread();
+  DWORD_PTR original_mask = 0;
+  double first_origin = 0.0;
+  for (size_t i = 0; i < sizeof(process_mask) * 8; ++i) {
+    DWORD_PTR mask = static_cast<DWORD_PTR>(1) << i;
+    if ((process_mask & mask) == 0)
+      continue;
+
+    DWORD_PTR previous_mask = ::SetThreadAffinityMask(thread, mask);
+    if (previous_mask == 0)
+      continue;
+    if (original_mask == 0)
+      original_mask = previous_mask;
+    ::Sleep(0);
+
+    // Take the TSC reading that's the most tightly bracketed by performance
+    // counter readings, and extrapolate it to the performance counter's
+    // origin.
+    uint64 best_width = kuint64max;
+    double origin = 0.0;
+    for (size_t j = 0; j < kTscOffsetRounds; ++j) {
+      LARGE_INTEGER before = {};
+      LARGE_INTEGER after = {};
+      ::QueryPerformanceCounter(&before);
+      uint64 tsc = __rdtsc();
+      ::QueryPerformanceCounter(&after);
+
+      uint64 width = after.QuadPart - before.QuadPart;
+      if (width >= best_width)
+        continue;
+      best_width = width;
+      double qpc = (before.QuadPart + after.QuadPart) / 2.0;
+      origin = static_cast<double>(tsc) - qpc * tsc_per_qpc;
+    }
+
+    if (tsc_offsets->empty())
+      first_origin = origin;
+    tsc_offsets->push_back(static_cast<int64>(origin - first_origin));
+  }
+
+  if (original_mask != 0)
+    ::SetThreadAffinityMask(thread, original_mask);
+}
+
+}  // namespace
+
 // All tracing runs through this object.
 agent::profiler::Profiler Profiler::instance_;
 
@@ -302,6 +596,16 @@ class Profiler::ThreadState
   // Logs @p symbol into the trace.
   void LogSymbol(SymbolMap::Symbol* symbol);
 
+  // Logs the calibration of the profiler, then flushes the current trace
+  // buffer.
+  // @param invocation_overhead_cycles the cycles each invocation spends in
+  //     the instrumentation that aren't accounted for at runtime.
+  // @param tsc_read_cycles the minimum cost of a TSC read.
+  // @param tsc_offsets the estimated TSC offset of each processor.
+  void LogCalibration(uint64 invocation_overhead_cycles,
+                      uint64 tsc_read_cycles,
+                      const std::vector<int64>& tsc_offsets);
+
   // Processes a single function entry.
   void OnFunctionEntry(EntryFrame* entry_frame,
                        FuncAddr function,
@@ -312,6 +616,21 @@ class Profiler::ThreadState
                          RetAddr* return_address_location,
                          uint64 cycles);
 
+  // Processes a single function entry in a module instrumented with exit
+  // hooks.
+  void OnShadowFunctionEntry(EntryFrame* entry_frame,
+                             FuncAddr function,
+                             uint64 cycles);
+
+  // Processes a single function exit in a module instrumented with exit
+  // hooks. This also records the invocations whose exit hooks were skipped,
+  // e.g. by tail calls or exceptions, as ending now.
+  // @param return_address_location the location of the return address of the
+  //     exiting function.
+  // @param cycles_exit the time of exit.
+  void OnShadowFunctionExit(RetAddr* return_address_location,
+                            uint64 cycles_exit);
+
   // @name Callback notification implementation.
   // @{
   virtual void OnPageAdded(const void* page) OVERRIDE;
@@ -321,6 +640,10 @@ class Profiler::ThreadState
   // Function exit hook.
   void OnFunctionExit(const ThunkData* data, uint64 cycles_exit);
 
+  // Writes all the invocations aggregated so far to the trace, and empties
+  // the invocation table.
+  void SpillInvocations();
+
   trace::client::TraceFileSegment* segment() { return &segment_; }
 
  private:
@@ -332,7 +655,7 @@ class Profiler::ThreadState
 
   void UpdateOverhead(uint64 entry_cycles);
   InvocationInfo* AllocateInvocationInfo();
-  void ClearCache();
+  void SpillInvocation(const InvocationTable::Entry& entry);
   bool FlushSegment();
 
   // The profiler we're attached to.
@@ -344,8 +667,12 @@ class Profiler::ThreadState
   // measures time exclusive of profiling overhead.
   uint64 cycles_overhead_;
 
-  // The invocations we've recorded in our buffer.
-  InvocationMap invocations_;
+  // The invocations we've aggregated, but not yet written to the trace.
+  InvocationTable invocations_;
+
+  // The entries of the invocations in progress in modules instrumented with
+  // exit hooks.
+  ShadowStack shadow_stack_;
 
   // The trace file segment we're recording to.
   trace::client::TraceFileSegment segment_;
@@ -360,12 +687,15 @@ class Profiler::ThreadState
 Profiler::ThreadState::ThreadState(Profiler* profiler)
     : profiler_(profiler),
       cycles_overhead_(0LL),
+      invocations_(InvocationTable::kDefaultNumSlots),
       batch_(NULL) {
   Initialize();
 }
 
 Profiler::ThreadState::~ThreadState() {
-  ClearCache();
+  // Write out anything that wasn't spilled on thread detach.
+  SpillInvocations();
+  batch_ = NULL;
 
   // If we have an outstanding buffer, let's deallocate it now.
   if (segment_.write_ptr != NULL)
@@ -397,8 +727,12 @@ void Profiler::ThreadState::LogAllModules(HMODULE module) {
 }
 
 void Profiler::ThreadState::LogModule(HMODULE module) {
-  // This may flush our buffer, so let's clear our cache.
-  ClearCache();
+  // Make sure the invocations aggregated so far precede the module in the
+  // trace, as a new module may reuse the addresses of an unloaded one.
+  SpillInvocations();
+
+  // This may flush our buffer, so let's forget our batch.
+  batch_ = NULL;
   agent::common::LogModule(module, &profiler_->session_, &segment_);
 }
 
@@ -452,6 +786,43 @@ void Profiler::ThreadState::LogSymbol(SymbolMap::Symbol* symbol) {
                 symbol->name().data(), symbol->name().size() + 1);
 }
 
+void Profiler::ThreadState::LogCalibration(
+    uint64 invocation_overhead_cycles,
+    uint64 tsc_read_cycles,
+    const std::vector<int64>& tsc_offsets) {
+  if (profiler_->session_.IsDisabled())
+    return;
+
+  size_t calibration_size =
+      FIELD_OFFSET(TraceProfilerCalibration, tsc_offsets) +
+      tsc_offsets.size() * sizeof(tsc_offsets[0]);
+
+  if (!segment_.CanAllocate(calibration_size) || !FlushSegment()) {
+    // Failed to allocate the calibration record.
+    return;
+  }
+
+  DCHECK(segment_.CanAllocate(calibration_size));
+  batch_ = NULL;
+
+  // Allocate a record in the log.
+  TraceProfilerCalibration* calibration =
+      reinterpret_cast<TraceProfilerCalibration*>(
+          segment_.AllocateTraceRecordImpl(
+              TRACE_PROFILER_CALIBRATION, calibration_size));
+  DCHECK(calibration != NULL);
+  calibration->invocation_overhead_cycles = invocation_overhead_cycles;
+  calibration->tsc_read_cycles = tsc_read_cycles;
+  calibration->num_processors = tsc_offsets.size();
+  if (!tsc_offsets.empty()) {
+    ::memcpy(calibration->tsc_offsets, &tsc_offsets[0],
+             tsc_offsets.size() * sizeof(tsc_offsets[0]));
+  }
+
+  // The calibration must precede the invocation data in the trace.
+  FlushSegment();
+}
+
 void Profiler::ThreadState::OnFunctionEntry(EntryFrame* entry_frame,
                                             FuncAddr function,
                                             uint64 cycles) {
@@ -497,6 +868,32 @@ void Profiler::ThreadState::OnV8FunctionEntry(FuncAddr function,
   UpdateOverhead(cycles);
 }
 
+void Profiler::ThreadState::OnShadowFunctionEntry(EntryFrame* entry_frame,
+                                                  FuncAddr function,
+                                                  uint64 cycles) {
+  if (profiler_->session_.IsDisabled())
+    return;
+
+  shadow_stack_.Push(&entry_frame->retaddr, function,
+                     cycles - cycles_overhead_);
+
+  UpdateOverhead(cycles);
+}
+
+void Profiler::ThreadState::OnShadowFunctionExit(
+    RetAddr* return_address_location, uint64 cycles_exit) {
+  // Calculate the number of cycles in each invocation, exclusive our
+  // overhead.
+  ShadowStack::Frame frame = {};
+  while (shadow_stack_.Pop(return_address_location, &frame)) {
+    uint64 cycles_executed =
+        cycles_exit - cycles_overhead_ - frame.cycles_entry;
+    RecordInvocation(frame.caller, frame.function, cycles_executed);
+  }
+
+  UpdateOverhead(cycles_exit);
+}
+
 void Profiler::ThreadState::OnFunctionExit(const ThunkData* data,
                                            uint64 cycles_exit) {
   // Calculate the number of cycles in the invocation, exclusive our overhead.
@@ -532,40 +929,31 @@ void Profiler::ThreadState::RecordInvocation(RetAddr caller,
                                              FuncAddr function,
                                              uint64 duration_cycles) {
   // See whether we've already recorded an entry for this function.
-  InvocationKey key(caller, function);
-  InvocationMap::iterator it = invocations_.find(key);
-  if (it != invocations_.end()) {
+  InvocationTable::Entry* entry = invocations_.FindSlot(caller, function);
+  DCHECK(entry != NULL);
+  if (entry->Matches(caller, function)) {
     // Yup, we already have an entry, validate it.
-    InvocationValue& value = it->second;
-
-    if ((value.caller_symbol == NULL ||
-         value.caller_symbol->move_count() == value.caller_move_count) &&
-        (value.function_symbol == NULL ||
-         value.function_symbol->move_count() == value.function_move_count)) {
+    if (entry->IsValid()) {
       // The entry is still good, tally the new data.
-      ++(value.info->num_calls);
-      value.info->cycles_sum += duration_cycles;
-      if (duration_cycles < value.info->cycles_min) {
-        value.info->cycles_min = duration_cycles;
-      } else if (duration_cycles > value.info->cycles_max) {
-        value.info->cycles_max = duration_cycles;
-      }
+      entry->Tally(duration_cycles);
 
       // Early out on success.
       return;
-    } else {
-      // The entry is not valid any more, discard it.
-      DCHECK(value.caller_symbol != NULL || value.function_symbol != NULL);
-
-      invocations_.erase(it);
     }
+
+    // The entry is not valid any more, but its tally still stands.
+    DCHECK(entry->caller_symbol != NULL || entry->function_symbol != NULL);
   }
-  DCHECK(invocations_.find(key) == invocations_.end());
 
-  // We don't have an entry, allocate a new one for this invocation.
+  // We don't have an entry, so we'll claim this slot for this invocation.
   // The code below may touch last error.
   ScopedLastErrorKeeper keep_last_error;
 
+  // Write out the current occupant of the slot, if any, be it stale or
+  // evicted to make room.
+  if (entry->in_use())
+    SpillInvocation(*entry);
+
   scoped_refptr<SymbolMap::Symbol> caller_symbol =
       profiler_->symbol_map_.FindSymbol(caller);
 
@@ -588,56 +976,13 @@ void Profiler::ThreadState::RecordInvocation(RetAddr caller,
     LogSymbol(function_symbol);
   }
 
-  InvocationInfo* info = AllocateInvocationInfo();
-  if (info != NULL) {
-    InvocationValue& value = invocations_[key];
-    value.info = info;
-    value.caller_symbol = caller_symbol;
-    if (caller_symbol != NULL)
-      value.caller_move_count = caller_symbol->move_count();
-    else
-      value.caller_move_count = 0;
-
-    value.function_symbol = function_symbol;
-    if (function_symbol != NULL)
-      value.function_move_count = function_symbol->move_count();
-    else
-      value.function_move_count = 0;
-
-    if (function_symbol == NULL) {
-      // We're not in a dynamic function, record the (conventional) function.
-      info->function = function;
-      info->flags = 0;
-    } else {
-      // We're in a dynamic function symbol, record the details.
-      DCHECK_NE(function_symbol->id(), 0);
-
-      info->function_symbol_id = function_symbol->id();
-      info->flags = kFunctionIsSymbol;
-    }
-
-    if (caller_symbol == NULL) {
-      // We're not in a dynamic caller_symbol, record the (conventional) caller.
-      info->caller = caller;
-      info->caller_offset = 0;
-    } else {
-      // We're in a dynamic caller_symbol, record the details.
-      DCHECK_NE(caller_symbol->id(), 0);
-
-      info->caller_symbol_id = caller_symbol->id();
-      info->flags |= kCallerIsSymbol;
-      info->caller_offset = reinterpret_cast<const uint8*>(caller) -
-          reinterpret_cast<const uint8*>(caller_symbol->address());
-    }
-
-    info->num_calls = 1;
-    info->cycles_min = info->cycles_max = info->cycles_sum = duration_cycles;
-  }
+  invocations_.Insert(entry, caller, function, caller_symbol, function_symbol,
+                      duration_cycles);
 }
 
 void Profiler::ThreadState::UpdateOverhead(uint64 entry_cycles) {
-  // TODO(siggi): Measure the fixed overhead on setup,
-  //     then add it on every update.
+  // This doesn't account for the cycles spent in the thunks around the hooks.
+  // These are measured on startup and logged for the grinder to subtract.
   cycles_overhead_ += (__rdtsc() - entry_cycles);
 }
 
@@ -676,20 +1021,44 @@ InvocationInfo* Profiler::ThreadState::AllocateInvocationInfo() {
   return &batch_->invocations[0];
 }
 
-bool Profiler::ThreadState::FlushSegment() {
-  ClearCache();
-  return profiler_->session_.ExchangeBuffer(&segment_);
+void Profiler::ThreadState::SpillInvocation(
+    const InvocationTable::Entry& entry) {
+  DCHECK(entry.in_use());
+
+  // If we fail to allocate a record, the tally is lost.
+  InvocationInfo* info = AllocateInvocationInfo();
+  if (info != NULL)
+    entry.ToInvocationInfo(info);
 }
 
-void Profiler::ThreadState::ClearCache() {
+void Profiler::ThreadState::SpillInvocations() {
+  if (invocations_.empty())
+    return;
+
+  if (!profiler_->session_.IsDisabled()) {
+    InvocationTable::iterator it = invocations_.begin();
+    for (; it != invocations_.end(); ++it) {
+      if (it->in_use())
+        SpillInvocation(*it);
+    }
+  }
+
+  invocations_.Clear();
+}
+
+bool Profiler::ThreadState::FlushSegment() {
   batch_ = NULL;
-  invocations_.clear();
+  return profiler_->session_.ExchangeBuffer(&segment_);
 }
 
 void Profiler::OnThreadDetach() {
   ThreadState* state = GetThreadState();
-  if (state != NULL)
+  if (state != NULL) {
+    // Spill the aggregated invocations while we're still on the thread that
+    // owns them, so that they're attributed to it in the trace.
+    state->SpillInvocations();
     thread_state_manager_.MarkForDeath(state);
+  }
 }
 
 RetAddr* Profiler::ResolveReturnAddressLocation(RetAddr* pc_location) {
@@ -721,7 +1090,8 @@ RetAddr* Profiler::ResolveReturnAddressLocation(RetAddr* pc_location) {
 
 void Profiler::OnModuleEntry(EntryFrame* entry_frame,
                              FuncAddr function,
-                             uint64 cycles) {
+                             uint64 cycles,
+                             bool use_shadow_stack) {
   // The function invoked has a DllMain-like signature.
   // Get the module and reason from its invocation record.
   HMODULE module = reinterpret_cast<HMODULE>(entry_frame->args[0]);
@@ -763,7 +1133,10 @@ void Profiler::OnModuleEntry(EntryFrame* entry_frame,
   }
 
   // Handle the function entry.
-  data->OnFunctionEntry(entry_frame, function, cycles);
+  if (use_shadow_stack)
+    data->OnShadowFunctionEntry(entry_frame, function, cycles);
+  else
+    data->OnFunctionEntry(entry_frame, function, cycles);
 }
 
 void Profiler::OnPageAdded(const void* page) {
@@ -834,6 +1207,8 @@ Profiler::Profiler() : handler_registration_(NULL) {
   ThreadState* data = CreateFirstThreadStateAndSession();
   CHECK(data != NULL) << "Failed to allocate thread local state.";
 
+  Calibrate(data);
+
   handler_registration_ = ::AddVectoredExceptionHandler(TRUE, ExceptionHandler);
 
   dll_watcher_.Init(base::Bind(&Profiler::OnDllEvent, base::Unretained(this)));
@@ -857,6 +1232,23 @@ Profiler::~Profiler() {
   }
 }
 
+void Profiler::Calibrate(ThreadState* data) {
+  DCHECK(data != NULL);
+
+  if (!session_.IsTracing())
+    return;
+
+  uint64 tsc_read_cycles = 0;
+  uint64 invocation_overhead_cycles = 0;
+  MeasureInvocationOverhead(&tsc_read_cycles, &invocation_overhead_cycles);
+
+  std::vector<int64> tsc_offsets;
+  MeasureTscOffsets(&tsc_offsets);
+
+  data->LogCalibration(invocation_overhead_cycles, tsc_read_cycles,
+                       tsc_offsets);
+}
+
 Profiler::ThreadState* Profiler::CreateFirstThreadStateAndSession() {
   Profiler::ThreadState* data = GetOrAllocateThreadStateImpl();
 
@@ -909,7 +1301,7 @@ void WINAPI Profiler::DllMainEntryHook(EntryFrame* entry_frame,
                                        uint64 cycles) {
   ScopedLastErrorKeeper keep_last_error;
 
-  instance_.OnModuleEntry(entry_frame, function, cycles);
+  instance_.OnModuleEntry(entry_frame, function, cycles, false);
 }
 
 void WINAPI Profiler::FunctionEntryHook(EntryFrame* entry_frame,
@@ -933,6 +1325,35 @@ void WINAPI Profiler::OnV8FunctionEntry(FuncAddr function,
     data->OnV8FunctionEntry(function, return_addr_location, cycles);
 }
 
+void WINAPI Profiler::ShadowDllMainEntryHook(EntryFrame* entry_frame,
+                                             FuncAddr function,
+                                             uint64 cycles) {
+  ScopedLastErrorKeeper keep_last_error;
+
+  instance_.OnModuleEntry(entry_frame, function, cycles, true);
+}
+
+void WINAPI Profiler::ShadowFunctionEntryHook(EntryFrame* entry_frame,
+                                              FuncAddr function,
+                                              uint64 cycles) {
+  ScopedLastErrorKeeper keep_last_error;
+
+  ThreadState* data = instance_.GetOrAllocateThreadState();
+  DCHECK(data != NULL);
+  if (data != NULL)
+    data->OnShadowFunctionEntry(entry_frame, function, cycles);
+}
+
+void WINAPI Profiler::FunctionExitHook(RetAddr* return_address_location,
+                                       uint64 cycles) {
+  ScopedLastErrorKeeper keep_last_error;
+
+  // A thread without state has no entries to pop.
+  ThreadState* data = instance_.GetThreadState();
+  if (data != NULL)
+    data->OnShadowFunctionExit(return_address_location, cycles);
+}
+
 void Profiler::AddSymbol(const void* address, size_t length,
                          const char* name, size_t name_len) {
   symbol_map_.AddSymbol(address, length, base::StringPiece(name, name_len));
@@ -21,8 +21,12 @@
       'target_name': 'profile_lib',
       'type': 'static_library',
       'sources': [
+        'invocation_table.cc',
+        'invocation_table.h',
         'return_thunk_factory.cc',
         'return_thunk_factory.h',
+        'shadow_stack.cc',
+        'shadow_stack.h',
         'symbol_map.cc',
         'symbol_map.h',
       ],
@@ -42,17 +46,20 @@
         '<(src)/syzygy/common/common.gyp:common_lib',
         '<(src)/syzygy/common/common.gyp:syzygy_version',
         '<(src)/syzygy/core/core.gyp:core_lib',
-        '<(src)/syzygy/trace/rpc/rpc.gyp:rpc_common_lib',
         '<(src)/syzygy/trace/client/client.gyp:rpc_client_lib',
+        '<(src)/syzygy/trace/common/common.gyp:trace_common_lib',
+        '<(src)/syzygy/trace/rpc/rpc.gyp:rpc_common_lib',
       ],
     },
     {
       'target_name': 'profile_unittests',
       'type': 'executable',
       'sources': [
+        'invocation_table_unittest.cc',
         'profiler_unittest.cc',
         'profiler_unittests_main.cc',
         'return_thunk_factory_unittest.cc',
+        'shadow_stack_unittest.cc',
         'symbol_map_unittest.cc',
       ],
       'dependencies': [
@@ -15,7 +15,9 @@
 // A hierarchical profiler, indended for use with the Syzygy function level
 // instrumenter. The Syzygy instrumented provides a function entry hook, and
 // this implementation uses a shadow stack with return address swizzling to
-// get an exit hook.
+// get an exit hook. Alternatively, the instrumenter can emit exit hooks ahead
+// of each return, in which case the profiler keeps a per-thread shadow stack
+// of entries and leaves the return addresses alone.
 // The profiler uses RDTSC as wall clock, which makes it unsuitable for
 // profiling on systems with CPUs prior to AMD Barcelona/Phenom, or older
 // Intel processors, see e.g. http://en.wikipedia.org/wiki/Time_Stamp_Counter
@@ -43,6 +45,12 @@ extern "C" void _cdecl _indirect_penter_dllmain();
 extern "C" void _cdecl _indirect_penter_inside_function();
 extern void pexit();
 
+// Assembly instrumentation stubs to handle function entry and exit in modules
+// instrumented with exit hooks.
+extern "C" void _cdecl _indirect_penter_shadow();
+extern "C" void _cdecl _indirect_penter_shadow_dllmain();
+extern "C" void _cdecl _indirect_pexit();
+
 // Add a symbol to the dynamic symbol store.
 // @param address the start address of the new symbol.
 // @param length the length of the new symbol.
@@ -76,6 +84,20 @@ class Profiler {
                                        RetAddr* return_addr_location,
                                        uint64 cycles);
 
+  // @name Hooks for modules instrumented with exit hooks.
+  // @{
+  static void WINAPI ShadowDllMainEntryHook(EntryFrame* entry_frame,
+                                            FuncAddr function,
+                                            uint64 cycles);
+
+  static void WINAPI ShadowFunctionEntryHook(EntryFrame* entry_frame,
+                                             FuncAddr function,
+                                             uint64 cycles);
+
+  static void WINAPI FunctionExitHook(RetAddr* return_address_location,
+                                      uint64 cycles);
+  // @}
+
   // Adds a symbol to the dynamic symbol store.
   // @param address the start address of the new symbol.
   // @param length the length of the new symbol.
@@ -110,10 +132,13 @@ class Profiler {
   Profiler();
   ~Profiler();
 
-  // Called form DllMainEntryHook.
+  // Called form DllMainEntryHook and ShadowDllMainEntryHook.
+  // @param use_shadow_stack true iff the module was instrumented with exit
+  //     hooks.
   void OnModuleEntry(EntryFrame* entry_frame,
                      FuncAddr function,
-                     uint64 cycles);
+                     uint64 cycles,
+                     bool use_shadow_stack);
 
   // Callbacks from ThreadState.
   void OnPageAdded(const void* page);
@@ -135,6 +160,10 @@ class Profiler {
                   const base::StringPiece16& dll_path,
                   const base::StringPiece16& dll_base_name);
 
+  // Measures the timing error introduced by the instrumentation on this
+  // machine, and logs it through @p data ahead of any invocation data.
+  void Calibrate(ThreadState* data);
+
   ThreadState* CreateFirstThreadStateAndSession();
   ThreadState* GetOrAllocateThreadState();
   ThreadState* GetOrAllocateThreadStateImpl();
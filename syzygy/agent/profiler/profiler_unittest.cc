@@ -240,6 +240,13 @@ class ProfilerTest : public testing::Test {
     ASSERT_TRUE(_indirect_penter_dllmain_ != NULL);
     ASSERT_TRUE(_indirect_penter_ != NULL);
 
+    _indirect_penter_shadow_ =
+        ::GetProcAddress(module_, "_indirect_penter_shadow");
+    _indirect_pexit_ = ::GetProcAddress(module_, "_indirect_pexit");
+
+    ASSERT_TRUE(_indirect_penter_shadow_ != NULL);
+    ASSERT_TRUE(_indirect_pexit_ != NULL);
+
     resolution_func_ = reinterpret_cast<ResolveReturnAddressLocationFunc>(
         ::GetProcAddress(module_, "ResolveReturnAddressLocation"));
     ASSERT_TRUE(resolution_func_ != NULL);
@@ -263,6 +270,8 @@ class ProfilerTest : public testing::Test {
       module_ = NULL;
       _indirect_penter_ = NULL;
       _indirect_penter_dllmain_ = NULL;
+      _indirect_penter_shadow_ = NULL;
+      _indirect_pexit_ = NULL;
     }
   }
 
@@ -286,6 +295,7 @@ class ProfilerTest : public testing::Test {
 
   static int IndirectFunctionA(int param1, const void* param2);
   static int FunctionAThunk(int param1, const void* param2);
+  static int FunctionAWithExitHook(int param1, const void* param2);
   static int TestResolutionFuncThunk(ResolveReturnAddressLocationFunc resolver);
   static int TestResolutionFuncNestedThunk(
       ResolveReturnAddressLocationFunc resolver);
@@ -311,10 +321,14 @@ class ProfilerTest : public testing::Test {
 
   static FARPROC _indirect_penter_;
   static FARPROC _indirect_penter_dllmain_;
+  static FARPROC _indirect_penter_shadow_;
+  static FARPROC _indirect_pexit_;
 };
 
 FARPROC ProfilerTest::_indirect_penter_ = NULL;
 FARPROC ProfilerTest::_indirect_penter_dllmain_ = NULL;
+FARPROC ProfilerTest::_indirect_penter_shadow_ = NULL;
+FARPROC ProfilerTest::_indirect_pexit_ = NULL;
 
 BOOL WINAPI ProfilerTest::IndirectDllMain(HMODULE module,
                                           DWORD reason,
@@ -398,6 +412,19 @@ int __declspec(naked) ProfilerTest::FunctionAThunk(int param1,
   }
 }
 
+// This mimics IndirectFunctionA as instrumented with an entry call and an exit
+// hook.
+int __declspec(naked) ProfilerTest::FunctionAWithExitHook(int param1,
+                                                          const void* param2) {
+  __asm {
+    call _indirect_penter_shadow_
+    mov eax, DWORD PTR[esp + 4]
+    add eax, DWORD PTR[esp + 8]
+    call _indirect_pexit_
+    ret
+  }
+}
+
 void TestResolutionFunc(ResolveReturnAddressLocationFunc resolver) {
   uintptr_t pc_location =
       reinterpret_cast<uintptr_t>(_AddressOfReturnAddress());
@@ -467,6 +494,8 @@ TEST_F(ProfilerTest, RecordsAllModulesAndFunctions) {
 
   // Set up expectations for what should be in the trace.
   EXPECT_CALL(handler_, OnProcessStarted(_, ::GetCurrentProcessId(), _));
+  EXPECT_CALL(handler_,
+              OnProfilerCalibration(_, ::GetCurrentProcessId(), _));
   for (size_t i = 0; i < modules.size(); ++i) {
     EXPECT_CALL(handler_, OnProcessAttach(_,
                                           ::GetCurrentProcessId(),
@@ -504,6 +533,14 @@ void InvokeFunctionAThunk() {
   const int kExpected = kParam1 + reinterpret_cast<int>(kParam2);
   EXPECT_EQ(kExpected, ProfilerTest::FunctionAThunk(kParam1, kParam2));
 }
+
+void InvokeFunctionAWithExitHook() {
+  const int kParam1 = 0xFAB;
+  const void* kParam2 = &kParam1;
+  const int kExpected = kParam1 + reinterpret_cast<int>(kParam2);
+  EXPECT_EQ(kExpected,
+            ProfilerTest::FunctionAWithExitHook(kParam1, kParam2));
+}
 #pragma auto_inline(on)
 
 }  // namespace
@@ -539,6 +576,8 @@ TEST_F(ProfilerTest, RecordsOneEntryPerModuleAndFunction) {
   ASSERT_NO_FATAL_FAILURE(UnloadDll());
 
   EXPECT_CALL(handler_, OnProcessStarted(_, ::GetCurrentProcessId(), _));
+  EXPECT_CALL(handler_,
+              OnProfilerCalibration(_, ::GetCurrentProcessId(), _));
 
   // We should only have one event per module,
   // despite the double DllMain invocation.
@@ -563,6 +602,39 @@ TEST_F(ProfilerTest, RecordsOneEntryPerModuleAndFunction) {
   ASSERT_NO_FATAL_FAILURE(ReplayLogs());
 }
 
+TEST_F(ProfilerTest, ShadowStackRecordsOneEntryPerFunction) {
+  // Spin up the RPC service.
+  ASSERT_NO_FATAL_FAILURE(StartService());
+
+  ASSERT_NO_FATAL_FAILURE(LoadDll());
+
+  // Invoke Function A twice through the exit hook instrumentation.
+  ASSERT_NO_FATAL_FAILURE(InvokeFunctionAWithExitHook());
+  ASSERT_NO_FATAL_FAILURE(InvokeFunctionAWithExitHook());
+
+  ASSERT_NO_FATAL_FAILURE(UnloadDll());
+
+  EXPECT_CALL(handler_, OnProcessStarted(_, ::GetCurrentProcessId(), _));
+  EXPECT_CALL(handler_,
+              OnProfilerCalibration(_, ::GetCurrentProcessId(), _));
+  EXPECT_CALL(handler_, OnProcessAttach(_,
+                                        ::GetCurrentProcessId(),
+                                        ::GetCurrentThreadId(),
+                                        _))
+      .Times(testing::AnyNumber());
+
+  // Both invocations are tallied in a single record.
+  EXPECT_CALL(handler_, OnInvocationBatch(_,
+                                          ::GetCurrentProcessId(),
+                                          ::GetCurrentThreadId(),
+                                          1,
+                                          _));
+  EXPECT_CALL(handler_, OnProcessEnded(_, ::GetCurrentProcessId()));
+
+  // Replay the log.
+  ASSERT_NO_FATAL_FAILURE(ReplayLogs());
+}
+
 TEST_F(ProfilerTest, RecordsThreadName) {
   if (::IsDebuggerPresent()) {
     LOG(WARNING) << "This test fails under debugging.";
@@ -585,6 +657,8 @@ TEST_F(ProfilerTest, RecordsThreadName) {
   ASSERT_NO_FATAL_FAILURE(UnloadDll());
 
   EXPECT_CALL(handler_, OnProcessStarted(_, ::GetCurrentProcessId(), _));
+  EXPECT_CALL(handler_,
+              OnProfilerCalibration(_, ::GetCurrentProcessId(), _));
   EXPECT_CALL(handler_, OnProcessAttach(_,
                                         ::GetCurrentProcessId(),
                                         ::GetCurrentThreadId(),
@@ -641,6 +715,8 @@ TEST_F(ProfilerTest, RecordsUsedSymbols) {
   ASSERT_NO_FATAL_FAILURE(UnloadDll());
 
   EXPECT_CALL(handler_, OnProcessStarted(_, ::GetCurrentProcessId(), _));
+  EXPECT_CALL(handler_,
+              OnProfilerCalibration(_, ::GetCurrentProcessId(), _));
   EXPECT_CALL(handler_, OnProcessAttach(_,
                                         ::GetCurrentProcessId(),
                                         ::GetCurrentThreadId(),
@@ -690,6 +766,8 @@ TEST_F(ProfilerTest, OnDynamicFunctionEntry) {
   ASSERT_NO_FATAL_FAILURE(UnloadDll());
 
   EXPECT_CALL(handler_, OnProcessStarted(_, ::GetCurrentProcessId(), _));
+  EXPECT_CALL(handler_,
+              OnProfilerCalibration(_, ::GetCurrentProcessId(), _));
   EXPECT_CALL(handler_, OnProcessAttach(_,
                                         ::GetCurrentProcessId(),
                                         ::GetCurrentThreadId(),
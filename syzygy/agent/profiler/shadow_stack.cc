@@ -0,0 +1,67 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/profiler/shadow_stack.h"
+
+#include "base/logging.h"
+
+namespace agent {
+namespace profiler {
+
+ShadowStack::ShadowStack() {
+  frames_.reserve(kInitialCapacity);
+}
+
+void ShadowStack::Push(RetAddr* return_address_location,
+                       FuncAddr function,
+                       uint64 cycles_entry) {
+  DCHECK(return_address_location != NULL);
+
+  // The stack grows downwards, so an entry nested in the innermost frame
+  // must have its return address at or below that frame's.
+  DCHECK(frames_.empty() ||
+         return_address_location <= frames_.back().return_address_location);
+
+  Frame frame = { return_address_location,
+                  *return_address_location,
+                  function,
+                  cycles_entry };
+  frames_.push_back(frame);
+}
+
+bool ShadowStack::Pop(RetAddr* return_address_location, Frame* frame) {
+  DCHECK(return_address_location != NULL);
+  DCHECK(frame != NULL);
+
+  if (frames_.empty() ||
+      frames_.back().return_address_location > return_address_location) {
+    return false;
+  }
+
+  *frame = frames_.back();
+  frames_.pop_back();
+
+  // A tail-called function shares its return address location with the
+  // function that jumped to it.
+  if (!frames_.empty() &&
+      frames_.back().return_address_location ==
+          frame->return_address_location) {
+    frame->caller = frames_.back().function;
+  }
+
+  return true;
+}
+
+}  // namespace profiler
+}  // namespace agent
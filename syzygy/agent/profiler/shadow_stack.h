@@ -0,0 +1,95 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares ShadowStack, the per-thread stack of function entries the profiler
+// keeps when the instrumenter emits exit hooks, as an alternative to
+// swizzling return addresses to return thunks. Leaving the return addresses
+// alone keeps the processor's return stack buffer in sync with the real
+// stack, which the thunks defeat on every profiled return.
+//
+// Each frame is keyed on the location of the return address of the invocation
+// it records. An exit hook runs right before a return, when the stack pointer
+// refers to that location, and pops every frame at or below it. This takes
+// care of the frames that never see their exit hook, e.g. on tail calls,
+// where the callee shares the caller's return address location, or when an
+// exception unwinds through instrumented functions.
+
+#ifndef SYZYGY_AGENT_PROFILER_SHADOW_STACK_H_
+#define SYZYGY_AGENT_PROFILER_SHADOW_STACK_H_
+
+#include <vector>
+
+#include "base/basictypes.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
+
+namespace agent {
+namespace profiler {
+
+// A stack of function entries. Each stack is owned and used by a single
+// thread, hence there is no locking whatsoever.
+class ShadowStack {
+ public:
+  // The entry of a single invocation.
+  struct Frame {
+    // The location of the invocation's return address.
+    RetAddr* return_address_location;
+    // The caller and the function invoked.
+    RetAddr caller;
+    FuncAddr function;
+    // The time of entry.
+    uint64 cycles_entry;
+  };
+
+  ShadowStack();
+
+  // Pushes the entry of an invocation.
+  // @param return_address_location the location of the return address of
+  //     the invocation, which must hold the caller's address.
+  // @param function the function invoked.
+  // @param cycles_entry the time of entry.
+  void Push(RetAddr* return_address_location,
+            FuncAddr function,
+            uint64 cycles_entry);
+
+  // Pops the innermost frame if it was pushed for a return address location
+  // at or below @p return_address_location, e.g. on exit from the invocation
+  // returning through that location.
+  // @param return_address_location the location of the return address of
+  //     the invocation being exited.
+  // @param frame receives the popped frame. If the invocation was tail-called
+  //     by the next frame on the stack, its caller is set to that frame's
+  //     function, as its own return address refers to the original caller.
+  // @returns true if a frame was popped, false otherwise.
+  bool Pop(RetAddr* return_address_location, Frame* frame);
+
+  // @returns the number of frames on the stack.
+  size_t size() const { return frames_.size(); }
+
+  // @returns true iff the stack holds no frames.
+  bool empty() const { return frames_.empty(); }
+
+  // The number of frames storage is initially reserved for.
+  static const size_t kInitialCapacity = 256;
+
+ private:
+  // The frames, innermost last.
+  std::vector<Frame> frames_;
+
+  DISALLOW_COPY_AND_ASSIGN(ShadowStack);
+};
+
+}  // namespace profiler
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_PROFILER_SHADOW_STACK_H_
@@ -0,0 +1,110 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/profiler/shadow_stack.h"
+
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace profiler {
+
+namespace {
+
+const FuncAddr kFunction1 = reinterpret_cast<FuncAddr>(0x1000);
+const FuncAddr kFunction2 = reinterpret_cast<FuncAddr>(0x2000);
+const FuncAddr kFunction3 = reinterpret_cast<FuncAddr>(0x3000);
+const RetAddr kCaller1 = reinterpret_cast<RetAddr>(0x4000);
+const RetAddr kCaller2 = reinterpret_cast<RetAddr>(0x5000);
+
+class ShadowStackTest : public testing::Test {
+ public:
+  ShadowStackTest() {
+    ::memset(stack_, 0, sizeof(stack_));
+  }
+
+ protected:
+  // A fake machine stack holding return addresses.
+  RetAddr stack_[16];
+  ShadowStack shadow_stack_;
+};
+
+}  // namespace
+
+TEST_F(ShadowStackTest, PushAndPop) {
+  EXPECT_TRUE(shadow_stack_.empty());
+
+  stack_[10] = kCaller1;
+  shadow_stack_.Push(&stack_[10], kFunction1, 100);
+  stack_[8] = kCaller2;
+  shadow_stack_.Push(&stack_[8], kFunction2, 200);
+  EXPECT_EQ(2U, shadow_stack_.size());
+
+  ShadowStack::Frame frame = {};
+
+  // Nothing is popped by an exit from a frame further down the stack.
+  EXPECT_FALSE(shadow_stack_.Pop(&stack_[4], &frame));
+  EXPECT_EQ(2U, shadow_stack_.size());
+
+  EXPECT_TRUE(shadow_stack_.Pop(&stack_[8], &frame));
+  EXPECT_EQ(&stack_[8], frame.return_address_location);
+  EXPECT_EQ(kCaller2, frame.caller);
+  EXPECT_EQ(kFunction2, frame.function);
+  EXPECT_EQ(200U, frame.cycles_entry);
+  EXPECT_FALSE(shadow_stack_.Pop(&stack_[8], &frame));
+
+  EXPECT_TRUE(shadow_stack_.Pop(&stack_[10], &frame));
+  EXPECT_EQ(kCaller1, frame.caller);
+  EXPECT_EQ(kFunction1, frame.function);
+  EXPECT_EQ(100U, frame.cycles_entry);
+  EXPECT_TRUE(shadow_stack_.empty());
+}
+
+TEST_F(ShadowStackTest, PopsMissedExits) {
+  // Nested frames whose exit hooks were skipped, e.g. by an exception.
+  stack_[12] = kCaller1;
+  shadow_stack_.Push(&stack_[12], kFunction1, 100);
+  stack_[10] = kCaller2;
+  shadow_stack_.Push(&stack_[10], kFunction2, 200);
+  stack_[6] = kCaller2;
+  shadow_stack_.Push(&stack_[6], kFunction3, 300);
+
+  // An exit from the outermost frame pops all of them, innermost first.
+  ShadowStack::Frame frame = {};
+  ASSERT_TRUE(shadow_stack_.Pop(&stack_[12], &frame));
+  EXPECT_EQ(kFunction3, frame.function);
+  ASSERT_TRUE(shadow_stack_.Pop(&stack_[12], &frame));
+  EXPECT_EQ(kFunction2, frame.function);
+  ASSERT_TRUE(shadow_stack_.Pop(&stack_[12], &frame));
+  EXPECT_EQ(kFunction1, frame.function);
+  EXPECT_FALSE(shadow_stack_.Pop(&stack_[12], &frame));
+}
+
+TEST_F(ShadowStackTest, AttributesTailCallsToTheCallingFunction) {
+  // Function 1 tail-calls function 2, which shares its return address.
+  stack_[10] = kCaller1;
+  shadow_stack_.Push(&stack_[10], kFunction1, 100);
+  shadow_stack_.Push(&stack_[10], kFunction2, 200);
+
+  ShadowStack::Frame frame = {};
+  ASSERT_TRUE(shadow_stack_.Pop(&stack_[10], &frame));
+  EXPECT_EQ(kFunction2, frame.function);
+  EXPECT_EQ(kFunction1, frame.caller);
+
+  ASSERT_TRUE(shadow_stack_.Pop(&stack_[10], &frame));
+  EXPECT_EQ(kFunction1, frame.function);
+  EXPECT_EQ(kCaller1, frame.caller);
+}
+
+}  // namespace profiler
+}  // namespace agent
@@ -14,15 +14,36 @@
 
 #include "syzygy/agent/profiler/symbol_map.h"
 
+#include <windows.h>
+#include <algorithm>
+
 namespace agent {
 namespace profiler {
 
+namespace {
+
+// Orders snapshot entries with respect to an address, by their end address.
+struct EntryEndsBefore {
+  template <typename Entry>
+  bool operator()(const Entry& entry, const uint8* addr) const {
+    return entry.first.end() <= addr;
+  }
+};
+
+}  // namespace
+
 base::subtle::Atomic32 SymbolMap::Symbol::next_symbol_id_ = 0;
 
-SymbolMap::SymbolMap() {
+SymbolMap::SymbolMap() : snapshot_(0), epoch_(0) {
+  readers_[0] = 0;
+  readers_[1] = 0;
 }
 
 SymbolMap::~SymbolMap() {
+  // There can't be any readers left at this point.
+  DCHECK_EQ(0, readers_[0]);
+  DCHECK_EQ(0, readers_[1]);
+  delete snapshot();
 }
 
 void SymbolMap::AddSymbol(const void* start_addr,
@@ -41,6 +62,7 @@ void SymbolMap::AddSymbol(const void* start_addr,
   bool inserted = addr_space_.Insert(
       Range(reinterpret_cast<const uint8*>(start_addr), length), symbol);
   DCHECK(inserted);
+  PublishSnapshotUnlocked();
 }
 
 void SymbolMap::MoveSymbol(const void* old_addr, const void* new_addr) {
@@ -70,19 +92,31 @@ void SymbolMap::MoveSymbol(const void* old_addr, const void* new_addr) {
   bool inserted = addr_space_.Insert(
       Range(reinterpret_cast<const uint8*>(new_addr), length), symbol);
   DCHECK(inserted);
+  PublishSnapshotUnlocked();
 }
 
 scoped_refptr<SymbolMap::Symbol> SymbolMap::FindSymbol(const void* addr) {
-  base::AutoLock hold(lock_);
-
-  SymbolAddressSpace::RangeMapIter found =
-      addr_space_.FindFirstIntersection(
-          Range(reinterpret_cast<const uint8*>(addr), 1));
-
-  if (found == addr_space_.end())
-    return NULL;
-
-  return found->second;
+  // Register as a reader of the current epoch. The full barrier ensures the
+  // snapshot is loaded after the registration is visible to the writers.
+  base::subtle::Atomic32* readers =
+      &readers_[base::subtle::Acquire_Load(&epoch_) & 1];
+  base::subtle::Barrier_AtomicIncrement(readers, 1);
+
+  scoped_refptr<Symbol> symbol;
+  const Snapshot* current = snapshot();
+  if (current != NULL) {
+    // Find the first entry ending past addr. The entries don't overlap, so
+    // it's the only one that may contain it.
+    const uint8* address = reinterpret_cast<const uint8*>(addr);
+    Snapshot::const_iterator it = std::lower_bound(
+        current->begin(), current->end(), address, EntryEndsBefore());
+    if (it != current->end() && it->first.Contains(address))
+      symbol = it->second;
+  }
+
+  base::subtle::Barrier_AtomicIncrement(readers, -1);
+
+  return symbol;
 }
 
 void SymbolMap::RetireRangeUnlocked(const Range& range) {
@@ -92,11 +126,50 @@ void SymbolMap::RetireRangeUnlocked(const Range& range) {
       addr_space_.FindIntersecting(range);
   SymbolAddressSpace::iterator it = found.first;
   for (; it != found.second; ++it)
-    found.first->second->Invalidate();
+    it->second->Invalidate();
 
   addr_space_.Remove(found);
 }
 
+void SymbolMap::PublishSnapshotUnlocked() {
+  lock_.AssertAcquired();
+
+  Snapshot* new_snapshot = NULL;
+  if (!addr_space_.empty()) {
+    new_snapshot = new Snapshot(addr_space_.begin(), addr_space_.end());
+  }
+
+  const Snapshot* old_snapshot = snapshot();
+  base::subtle::Release_Store(
+      &snapshot_, reinterpret_cast<base::subtle::AtomicWord>(new_snapshot));
+
+  if (old_snapshot == NULL)
+    return;
+
+  WaitForReadersUnlocked();
+  delete old_snapshot;
+}
+
+void SymbolMap::WaitForReadersUnlocked() {
+  lock_.AssertAcquired();
+
+  // A reader that registered before a flip may still hold the old snapshot.
+  // One that registers after it loads the new snapshot, but may have picked
+  // its counter from the epoch before the flip, so both counters have to
+  // drain in turn.
+  for (size_t i = 0; i < 2; ++i) {
+    base::subtle::Atomic32 old_epoch =
+        base::subtle::Barrier_AtomicIncrement(&epoch_, 1) - 1;
+    while (base::subtle::Acquire_Load(&readers_[old_epoch & 1]) != 0)
+      ::Sleep(0);
+  }
+}
+
+const SymbolMap::Snapshot* SymbolMap::snapshot() const {
+  return reinterpret_cast<const Snapshot*>(
+      base::subtle::Acquire_Load(&snapshot_));
+}
+
 SymbolMap::Symbol::Symbol(const base::StringPiece& name, const void* address)
     : name_(name.begin(), name.end()),
       move_count_(0),
@@ -15,6 +15,9 @@
 #ifndef SYZYGY_AGENT_PROFILER_SYMBOL_MAP_H_
 #define SYZYGY_AGENT_PROFILER_SYMBOL_MAP_H_
 
+#include <utility>
+#include <vector>
+
 #include "base/atomicops.h"
 #include "base/basictypes.h"
 #include "base/string_piece.h"
@@ -49,7 +52,7 @@ class SymbolMap {
   // @param new_addr the new address of the symbol.
   void MoveSymbol(const void* old_addr, const void* new_addr);
 
-  // Find the symbol covering @p addr, if any.
+  // Find the symbol covering @p addr, if any. This doesn't take any lock.
   // @param addr an address to query.
   // @returns the symbol covering @p addr, if any, or NULL otherwise.
   scoped_refptr<Symbol> FindSymbol(const void* addr);
@@ -59,12 +62,34 @@ class SymbolMap {
       SymbolAddressSpace;
   typedef SymbolAddressSpace::Range Range;
 
+  // An immutable copy of addr_space_, sorted by address.
+  typedef std::vector<std::pair<Range, scoped_refptr<Symbol> > > Snapshot;
+
   // Retire any symbols overlapping @p range.
   void RetireRangeUnlocked(const Range& range);
 
+  // Publishes a snapshot of addr_space_ to the readers, and reclaims the one
+  // it replaces once no reader can be looking at it anymore.
+  void PublishSnapshotUnlocked();
+
+  // Waits until all the readers that may have seen the previously published
+  // snapshot are done with it.
+  void WaitForReadersUnlocked();
+
+  // @returns the current snapshot, which is NULL while the map is empty.
+  const Snapshot* snapshot() const;
+
   base::Lock lock_;
   SymbolAddressSpace addr_space_;  // Under lock_.
 
+  // The current snapshot. Written under lock_, read without.
+  base::subtle::AtomicWord snapshot_;
+
+  // The epoch whose parity selects the reader counter, and the number of
+  // readers in each counter.
+  base::subtle::Atomic32 epoch_;
+  base::subtle::Atomic32 readers_[2];
+
  private:
   DISALLOW_COPY_AND_ASSIGN(SymbolMap);
 };
@@ -14,6 +14,7 @@
 
 #include "syzygy/agent/profiler/symbol_map.h"
 
+#include "base/threading/simple_thread.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -24,9 +25,12 @@ namespace {
 
 class TestingSymbolMap : public SymbolMap {
  public:
-  // Expose the address space for testing.
+  // Expose the address space and the snapshot for testing.
   using SymbolMap::addr_space_;
+  using SymbolMap::readers_;
+  using SymbolMap::snapshot;
   typedef SymbolMap::SymbolAddressSpace SymbolAddressSpace;
+  typedef SymbolMap::Snapshot Snapshot;
 };
 
 const uint8* ToPtr(intptr_t number) {
@@ -38,6 +42,28 @@ class SymbolMapTest : public testing::Test {
   TestingSymbolMap symbol_map_;
 };
 
+// Repeatedly looks up a symbol that never moves.
+class FindSymbolDelegate : public base::DelegateSimpleThread::Delegate {
+ public:
+  FindSymbolDelegate(SymbolMap* symbol_map, const void* addr)
+      : symbol_map_(symbol_map), addr_(addr), failures_(0) {
+  }
+
+  virtual void Run() OVERRIDE {
+    for (size_t i = 0; i < 10000; ++i) {
+      if (symbol_map_->FindSymbol(addr_) == NULL)
+        ++failures_;
+    }
+  }
+
+  size_t failures() const { return failures_; }
+
+ private:
+  SymbolMap* symbol_map_;
+  const void* addr_;
+  size_t failures_;
+};
+
 }  // namespace
 
 TEST_F(SymbolMapTest, AddSymbol) {
@@ -175,5 +201,65 @@ TEST_F(SymbolMapTest, SymbolLifeCycle) {
   EXPECT_EQ(ToPtr(NULL), symbol->address());
 }
 
+TEST_F(SymbolMapTest, SnapshotTracksAddressSpace) {
+  EXPECT_TRUE(symbol_map_.snapshot() == NULL);
+
+  symbol_map_.AddSymbol(ToPtr(0x1000), 0x10, "foo");
+  symbol_map_.AddSymbol(ToPtr(0x3000), 0x10, "bar");
+  symbol_map_.MoveSymbol(ToPtr(0x3000), ToPtr(0x2000));
+
+  // The snapshot mirrors the address space, sorted by address.
+  const TestingSymbolMap::Snapshot* snapshot = symbol_map_.snapshot();
+  ASSERT_TRUE(snapshot != NULL);
+  ASSERT_EQ(2U, snapshot->size());
+  EXPECT_EQ(ToPtr(0x1000), snapshot->at(0).first.start());
+  EXPECT_EQ("foo", snapshot->at(0).second->name());
+  EXPECT_EQ(ToPtr(0x2000), snapshot->at(1).first.start());
+  EXPECT_EQ("bar", snapshot->at(1).second->name());
+
+  // Lookups in between and past the symbols find nothing.
+  EXPECT_TRUE(symbol_map_.FindSymbol(ToPtr(0x0FFF)) == NULL);
+  EXPECT_TRUE(symbol_map_.FindSymbol(ToPtr(0x1010)) == NULL);
+  EXPECT_TRUE(symbol_map_.FindSymbol(ToPtr(0x2010)) == NULL);
+  EXPECT_TRUE(symbol_map_.FindSymbol(ToPtr(0x3000)) == NULL);
+
+  // All readers are accounted for.
+  EXPECT_EQ(0, symbol_map_.readers_[0]);
+  EXPECT_EQ(0, symbol_map_.readers_[1]);
+}
+
+TEST_F(SymbolMapTest, ConcurrentFindSymbol) {
+  const uint8* const kStable = ToPtr(0x1000);
+  symbol_map_.AddSymbol(kStable, 0x10, "stable");
+
+  FindSymbolDelegate delegate1(&symbol_map_, kStable + 4);
+  FindSymbolDelegate delegate2(&symbol_map_, kStable + 8);
+  base::DelegateSimpleThread thread1(&delegate1, "reader1");
+  base::DelegateSimpleThread thread2(&delegate2, "reader2");
+  thread1.Start();
+  thread2.Start();
+
+  // Keep publishing snapshots while the readers are running.
+  const uint8* addr = ToPtr(0x10000);
+  symbol_map_.AddSymbol(addr, 0x10, "moving");
+  for (size_t i = 0; i < 1000; ++i) {
+    const uint8* new_addr = addr + 0x10;
+    symbol_map_.MoveSymbol(addr, new_addr);
+    addr = new_addr;
+  }
+
+  thread1.Join();
+  thread2.Join();
+
+  // The stable symbol is always found.
+  EXPECT_EQ(0U, delegate1.failures());
+  EXPECT_EQ(0U, delegate2.failures());
+
+  scoped_refptr<SymbolMap::Symbol> symbol = symbol_map_.FindSymbol(addr);
+  ASSERT_TRUE(symbol != NULL);
+  EXPECT_EQ("moving", symbol->name());
+  EXPECT_EQ(1000, symbol->move_count());
+}
+
 }  // namespace profiler
 }  // namespace agent
@@ -0,0 +1,92 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A class that computes the post-order of the basic code blocks of a subgraph,
+// and assigns them dense indices. The global dataflow analyses iterate in this
+// order, or its reverse, to reach their fix-point in fewer passes, and may
+// share a single instance so that the ordering is computed only once.
+
+#ifndef SYZYGY_BLOCK_GRAPH_ANALYSIS_CONTROL_FLOW_ANALYSIS_H_
+#define SYZYGY_BLOCK_GRAPH_ANALYSIS_CONTROL_FLOW_ANALYSIS_H_
+
+#include <map>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "syzygy/block_graph/basic_block.h"
+#include "syzygy/block_graph/basic_block_subgraph.h"
+
+namespace block_graph {
+namespace analysis {
+
+// Computes a post-order of the basic code blocks of a subgraph. Back-edges
+// aren't followed, and basic data blocks are skipped.
+//
+// Example:
+//
+//  ControlFlowAnalysis control_flow;
+//  control_flow.Analyze(subgraph);
+//
+//  // Visit the basic code blocks in reverse post-order.
+//  const ControlFlowAnalysis::BasicCodeBlockOrdering& order =
+//      control_flow.post_order();
+//  for (size_t i = order.size(); i > 0; --i) {
+//    const BasicCodeBlock* bb = order[i - 1];
+//    ...
+//  }
+class ControlFlowAnalysis {
+ public:
+  typedef block_graph::BasicBlockSubGraph BasicBlockSubGraph;
+  typedef std::vector<const BasicCodeBlock*> BasicCodeBlockOrdering;
+
+  // The index returned for the basic blocks that aren't part of the ordering.
+  static const size_t kInvalidIndex;
+
+  ControlFlowAnalysis();
+
+  // Computes the post-order of the basic code blocks of @p subgraph. This
+  // replaces the results of any previous analysis.
+  // @param subgraph Subgraph to analyze.
+  void Analyze(const BasicBlockSubGraph* subgraph);
+
+  // @returns the basic code blocks of the analyzed subgraph, in post-order.
+  const BasicCodeBlockOrdering& post_order() const { return post_order_; }
+
+  // @param bb The basic block to look up.
+  // @returns the index of @p bb in the post-order, or kInvalidIndex if it
+  //     isn't a basic code block of the analyzed subgraph.
+  size_t GetIndexOf(const BasicBlock* bb) const;
+
+  // Flattens the basic code blocks of @p basic_blocks in post-order.
+  // @param basic_blocks The basic blocks to flatten.
+  // @param order Receives the basic code blocks in post-order.
+  static void FlattenBasicBlocksInPostOrder(
+      const BasicBlockSubGraph::BBCollection& basic_blocks,
+      BasicCodeBlockOrdering* order);
+
+ private:
+  // The basic code blocks, in post-order.
+  BasicCodeBlockOrdering post_order_;
+
+  // The index of each basic code block in the post-order.
+  typedef std::map<const BasicBlock*, size_t> IndexMap;
+  IndexMap indices_;
+
+  DISALLOW_COPY_AND_ASSIGN(ControlFlowAnalysis);
+};
+
+}  // namespace analysis
+}  // namespace block_graph
+
+#endif  // SYZYGY_BLOCK_GRAPH_ANALYSIS_CONTROL_FLOW_ANALYSIS_H_
@@ -0,0 +1,124 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Unittests for control flow analysis.
+
+#include "syzygy/block_graph/analysis/control_flow_analysis.h"
+
+#include <algorithm>
+
+#include "gtest/gtest.h"
+
+namespace block_graph {
+namespace analysis {
+
+namespace {
+
+typedef ControlFlowAnalysis::BasicCodeBlockOrdering BasicCodeBlockOrdering;
+
+const uint8 kData[] = { 0x00, 0x01, 0x02, 0x03 };
+
+void AddSuccessorBetween(Successor::Condition condition,
+                         BasicCodeBlock* from,
+                         BasicCodeBlock* to) {
+  from->successors().push_back(
+      Successor(condition,
+                BasicBlockReference(BlockGraph::RELATIVE_REF,
+                                    BlockGraph::Reference::kMaximumSize,
+                                    to),
+                0));
+}
+
+}  // namespace
+
+TEST(ControlFlowAnalysisTest, Analyze) {
+  BasicBlockSubGraph subgraph;
+
+  BasicCodeBlock* bb_if = subgraph.AddBasicCodeBlock("if");
+  BasicCodeBlock* bb_true = subgraph.AddBasicCodeBlock("true");
+  BasicCodeBlock* bb_false = subgraph.AddBasicCodeBlock("false");
+  BasicCodeBlock* bb_end = subgraph.AddBasicCodeBlock("end");
+  BasicDataBlock* bb_data =
+      subgraph.AddBasicDataBlock("data", sizeof(kData), kData);
+  ASSERT_TRUE(bb_if != NULL);
+  ASSERT_TRUE(bb_true != NULL);
+  ASSERT_TRUE(bb_false != NULL);
+  ASSERT_TRUE(bb_end != NULL);
+  ASSERT_TRUE(bb_data != NULL);
+
+  // A diamond, with a back-edge from the end to the condition.
+  AddSuccessorBetween(Successor::kConditionEqual, bb_if, bb_true);
+  AddSuccessorBetween(Successor::kConditionNotEqual, bb_if, bb_false);
+  AddSuccessorBetween(Successor::kConditionTrue, bb_true, bb_end);
+  AddSuccessorBetween(Successor::kConditionTrue, bb_false, bb_end);
+  AddSuccessorBetween(Successor::kConditionTrue, bb_end, bb_if);
+
+  ControlFlowAnalysis control_flow;
+  control_flow.Analyze(&subgraph);
+
+  // Only the basic code blocks are ordered, each of them once.
+  const BasicCodeBlockOrdering& order = control_flow.post_order();
+  ASSERT_EQ(4u, order.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    EXPECT_EQ(i, control_flow.GetIndexOf(order[i]));
+  EXPECT_EQ(ControlFlowAnalysis::kInvalidIndex,
+            control_flow.GetIndexOf(bb_data));
+  EXPECT_EQ(ControlFlowAnalysis::kInvalidIndex,
+            control_flow.GetIndexOf(NULL));
+
+  // Analyzing again replaces the previous results.
+  BasicBlockSubGraph empty_subgraph;
+  control_flow.Analyze(&empty_subgraph);
+  EXPECT_TRUE(control_flow.post_order().empty());
+  EXPECT_EQ(ControlFlowAnalysis::kInvalidIndex,
+            control_flow.GetIndexOf(bb_if));
+}
+
+TEST(ControlFlowAnalysisTest, AcyclicPostOrder) {
+  BasicBlockSubGraph subgraph;
+
+  BasicCodeBlock* bb_if = subgraph.AddBasicCodeBlock("if");
+  BasicCodeBlock* bb_true = subgraph.AddBasicCodeBlock("true");
+  BasicCodeBlock* bb_false = subgraph.AddBasicCodeBlock("false");
+  BasicCodeBlock* bb_end = subgraph.AddBasicCodeBlock("end");
+  ASSERT_TRUE(bb_if != NULL);
+  ASSERT_TRUE(bb_true != NULL);
+  ASSERT_TRUE(bb_false != NULL);
+  ASSERT_TRUE(bb_end != NULL);
+
+  AddSuccessorBetween(Successor::kConditionEqual, bb_if, bb_true);
+  AddSuccessorBetween(Successor::kConditionNotEqual, bb_if, bb_false);
+  AddSuccessorBetween(Successor::kConditionTrue, bb_true, bb_end);
+  AddSuccessorBetween(Successor::kConditionTrue, bb_false, bb_end);
+
+  BasicCodeBlockOrdering order;
+  ControlFlowAnalysis::FlattenBasicBlocksInPostOrder(subgraph.basic_blocks(),
+                                                     &order);
+  ASSERT_EQ(4u, order.size());
+
+  // In an acyclic graph, every basic block follows all of its successors.
+  for (size_t i = 0; i < order.size(); ++i) {
+    const BasicBlock::Successors& successors = order[i]->successors();
+    BasicBlock::Successors::const_iterator succ = successors.begin();
+    for (; succ != successors.end(); ++succ) {
+      BasicCodeBlockOrdering::const_iterator it =
+          std::find(order.begin(), order.begin() + i,
+                    succ->reference().basic_block());
+      EXPECT_TRUE(it != order.begin() + i);
+    }
+  }
+}
+
+}  // namespace analysis
+}  // namespace block_graph
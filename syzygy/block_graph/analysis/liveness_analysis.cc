@@ -14,10 +14,9 @@
 
 #include "syzygy/block_graph/analysis/liveness_analysis.h"
 
-#include <set>
-#include <stack>
 #include <vector>
 
+#include "syzygy/block_graph/analysis/control_flow_analysis.h"
 #include "syzygy/block_graph/analysis/liveness_analysis_internal.h"
 #include "syzygy/core/assembler.h"
 #include "syzygy/core/disassembler_util.h"
@@ -29,7 +28,6 @@ namespace analysis {
 namespace {
 
 using core::Register;
-typedef BasicBlockSubGraph::BBCollection BBCollection;
 typedef block_graph::BasicBlockSubGraph::BasicBlock BasicBlock;
 typedef block_graph::BasicBlockSubGraph::BasicBlock::Instructions Instructions;
 typedef block_graph::BasicBlockSubGraph::BasicBlock::Successors Successors;
@@ -39,58 +37,6 @@ typedef LivenessAnalysis::State State;
 typedef LivenessAnalysis::State::RegisterMask RegisterMask;
 typedef LivenessAnalysis::State::FlagsMask FlagsMask;
 
-void FlattenBasicBlocksInPostOrder(
-    const BBCollection& basic_blocks,
-    std::vector<const BasicCodeBlock*>* order) {
-  // Build a reverse post-order (RPO) ordering of basic blocks. This is needed
-  // for faster fix-point convergence, but works with any ordering.
-  // TODO(etienneb): Hoist this to a ControlFlowAnalysis class.
-  std::set<const BasicBlock*> marked;
-  std::stack<const BasicBlock*> working;
-
-  // For each basic block, flatten its reachable sub-tree in post-order.
-  BBCollection::const_iterator iter_end = basic_blocks.end();
-  for (BBCollection::const_iterator iter = basic_blocks.begin();
-       iter != iter_end; ++iter) {
-    // When not marked, mark it and add it to working stack.
-    if (marked.insert(*iter).second)
-      working.push(*iter);
-
-    // Flatten this tree without following back-edge, push them in post-order.
-    while (!working.empty()) {
-      const BasicBlock* top = working.top();
-
-      // Skip data basic block.
-      const BasicCodeBlock* bb = BasicCodeBlock::Cast(top);
-      if (bb == NULL) {
-        working.pop();
-        continue;
-      }
-
-      // Add unvisited child to the working stack.
-      bool has_unvisited_child = false;
-      const BasicBlock::Successors& successors = bb->successors();
-      Successors::const_iterator succ_end = successors.end();
-      for (Successors::const_iterator succ = successors.begin();
-           succ != succ_end;  ++succ) {
-        BasicBlock* basic_block = succ->reference().basic_block();
-        // When not marked, mark it and add it to working stack.
-        if (marked.insert(basic_block).second) {
-          working.push(basic_block);
-          has_unvisited_child = true;
-          break;
-        }
-      }
-
-      if (!has_unvisited_child) {
-        // Push this basic block in post-order in the ordering.
-        order->push_back(bb);
-        working.pop();
-      }
-    }
-  }
-}
-
 }  // namespace
 
 State::State()
@@ -210,15 +156,23 @@ void LivenessAnalysis::PropagateBackward(const Instruction& instr,
 
 void LivenessAnalysis::Analyze(const BasicBlockSubGraph* subgraph) {
   DCHECK(subgraph != NULL);
+
+  ControlFlowAnalysis control_flow;
+  control_flow.Analyze(subgraph);
+  Analyze(control_flow);
+}
+
+void LivenessAnalysis::Analyze(const ControlFlowAnalysis& control_flow) {
   DCHECK(live_in_.empty());
 
-  // Produce a post-order basic blocks ordering.
-  const BBCollection& basic_blocks = subgraph->basic_blocks();
-  std::vector<const BasicCodeBlock*> order;
-  FlattenBasicBlocksInPostOrder(basic_blocks, &order);
+  // The basic blocks are visited in post-order, so that the successors of a
+  // basic block are usually visited before it.
+  const ControlFlowAnalysis::BasicCodeBlockOrdering& order =
+      control_flow.post_order();
 
   // Initialize liveness information of each basic block (empty set).
-  std::vector<const BasicCodeBlock*>::const_iterator fw_iter = order.begin();
+  ControlFlowAnalysis::BasicCodeBlockOrdering::const_iterator fw_iter =
+      order.begin();
   for (; fw_iter != order.end(); ++fw_iter)
     StateHelper::Clear(&live_in_[*fw_iter]);
 
@@ -228,10 +182,9 @@ void LivenessAnalysis::Analyze(const BasicBlockSubGraph* subgraph) {
   while (changed) {
     changed = false;
 
-    std::vector<const BasicCodeBlock*>::const_reverse_iterator  bb_iter =
-        order.rbegin();
-    for (; bb_iter != order.rend(); ++bb_iter) {
-      const BasicCodeBlock* bb = *bb_iter;
+    fw_iter = order.begin();
+    for (; fw_iter != order.end(); ++fw_iter) {
+      const BasicCodeBlock* bb = *fw_iter;
 
       // Merge current liveness information with every successor information.
       State state;
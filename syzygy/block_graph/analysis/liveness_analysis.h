@@ -36,6 +36,9 @@
 namespace block_graph {
 namespace analysis {
 
+// Forward declaration.
+class ControlFlowAnalysis;
+
 // This class implements a local and a global liveness analysis on a subgraph.
 //
 // The liveness analysis is a conservative analysis which tries to prove that
@@ -148,6 +151,11 @@ class LivenessAnalysis {
   // @param subgraph Subgraph to apply the analysis.
   void Analyze(const BasicBlockSubGraph* subgraph);
 
+  // Perform a global analysis using the ordering of a control flow analysis
+  // shared with other analyses of the same subgraph.
+  // @param control_flow The control flow analysis of the subgraph.
+  void Analyze(const ControlFlowAnalysis& control_flow);
+
  private:
   // Contains the registers alive at entry of each basic block.
   typedef std::map<const BasicBlock*, State> LiveMap;
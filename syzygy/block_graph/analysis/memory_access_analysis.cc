@@ -14,10 +14,10 @@
 
 #include "syzygy/block_graph/analysis/memory_access_analysis.h"
 
-#include <queue>
 #include <set>
 #include <vector>
 
+#include "syzygy/block_graph/analysis/control_flow_analysis.h"
 // TODO(etienneb): liveness analysis internal should be hoisted to an
 //     instructions helper namespace, and shared between analysis. It is quite
 //     common to get the information on registers defined or used by an
@@ -124,19 +124,33 @@ bool MemoryAccessAnalysis::Intersect(const block_graph::BasicBlock* bb,
   return changed;
 }
 
+void MemoryAccessAnalysis::Analyze(const BasicBlockSubGraph* subgraph) {
+  DCHECK(subgraph != NULL);
+
+  ControlFlowAnalysis control_flow;
+  control_flow.Analyze(subgraph);
+  Analyze(subgraph, control_flow);
+}
+
 // This function performs a global redundant memory access analysis.
 // It is a fix-point algorithm that produce the minimal set of memory locations,
 // at the entry of each basic block. The algorithm uses a work-list to follow
 // the control flow and re-insert each modified basic block into the work-list.
-// When the end of a basic block is reached, the algorithm performs the
-// intersection of the current state with all its successors.
-void MemoryAccessAnalysis::Analyze(const BasicBlockSubGraph* subgraph) {
+// The work-list is processed in reverse post-order, so that the predecessors
+// of a basic block are usually processed before it. When the end of a basic
+// block is reached, the algorithm performs the intersection of the current
+// state with all its successors.
+void MemoryAccessAnalysis::Analyze(const BasicBlockSubGraph* subgraph,
+                                   const ControlFlowAnalysis& control_flow) {
   DCHECK(subgraph != NULL);
 
-  std::queue<const BasicBlock*> working;
-  std::set<const BasicBlock*> marked;
+  // The work-list holds the reverse post-order ranks of the basic blocks.
+  const ControlFlowAnalysis::BasicCodeBlockOrdering& order =
+      control_flow.post_order();
+  std::set<size_t> working;
 
   states_.clear();
+  ComputePredecessors(subgraph);
 
   // Find initial basic blocks (entry-points), add them to working queue.
   const BasicBlockSubGraph::BlockDescriptionList& descriptions =
@@ -149,8 +163,14 @@ void MemoryAccessAnalysis::Analyze(const BasicBlockSubGraph* subgraph) {
     if (original_order.empty())
       continue;
     const BasicBlock* head = original_order.front();
-    if (marked.insert(head).second) {
-      working.push(original_order.front());
+    size_t index = control_flow.GetIndexOf(head);
+    if (index == ControlFlowAnalysis::kInvalidIndex) {
+      // Invalidate all.
+      states_.clear();
+      predecessors_.clear();
+      return;
+    }
+    if (working.insert(order.size() - 1 - index).second) {
       State empty;
       Intersect(head, empty);
     }
@@ -160,19 +180,11 @@ void MemoryAccessAnalysis::Analyze(const BasicBlockSubGraph* subgraph) {
 
   // Working set algorithm until fixed point.
   while (!working.empty()) {
-    const BasicBlock* bb = working.front();
-    working.pop();
-    marked.erase(bb);
-
-    const BasicCodeBlock* bb_code = BasicCodeBlock::Cast(bb);
-    if (bb_code == NULL) {
-      // Invalidate all.
-      states_.clear();
-      return;
-    }
+    const BasicCodeBlock* bb_code = order[order.size() - 1 - *working.begin()];
+    working.erase(working.begin());
 
     State state;
-    GetStateAtEntryOf(bb, &state);
+    GetStateAtEntryOf(bb_code, &state);
 
     // Walk through this basic block to obtain an updated state.
     const Instructions& instructions = bb_code->instructions();
@@ -188,23 +200,158 @@ void MemoryAccessAnalysis::Analyze(const BasicBlockSubGraph* subgraph) {
     BasicBlock::Successors::const_iterator succ = successors.begin();
     for (; succ != successors.end(); ++succ) {
       BasicBlock* basic_block = succ->reference().basic_block();
-      if (basic_block == NULL) {
+      size_t index = control_flow.GetIndexOf(basic_block);
+      if (index == ControlFlowAnalysis::kInvalidIndex) {
         // Invalidate all.
         states_.clear();
+        predecessors_.clear();
         return;
       }
 
-      // Intersect current state with successor 'basic_block'.
-      bool changed = Intersect(basic_block, state);
-      if (changed) {
-        // When not already in working queue, mark and add it.
-        if (marked.insert(basic_block).second)
-          working.push(basic_block);
+      // Intersect current state with successor 'basic_block'. When not
+      // already in the work-list, add it.
+      if (Intersect(basic_block, state))
+        working.insert(order.size() - 1 - index);
+    }
+  }
+}
+
+bool MemoryAccessAnalysis::IsPartiallyRedundant(
+    const BasicCodeBlock* bb,
+    const Instruction& instr,
+    BasicCodeBlockVector* predecessors) const {
+  DCHECK(bb != NULL);
+  DCHECK(predecessors != NULL);
+
+  predecessors->clear();
+
+  // All the predecessors of the basic block must be known.
+  if (pinned_.find(bb) != pinned_.end())
+    return false;
+  PredecessorMap::const_iterator preds = predecessors_.find(bb);
+  if (preds == predecessors_.end())
+    return false;
+
+  // The accesses must be performed on every path from the entry of the basic
+  // block, and be based on the registers values at the entry. This holds iff
+  // the accesses survive the instructions preceding @p instr.
+  State state;
+  state.Execute(instr);
+  Instructions::const_iterator inst_iter = bb->instructions().begin();
+  for (; inst_iter != bb->instructions().end(); ++inst_iter) {
+    if (&*inst_iter == &instr)
+      break;
+    PropagateForward(*inst_iter, &state);
+  }
+  DCHECK(inst_iter != bb->instructions().end());
+  if (state.HasNonRedundantAccess(instr))
+    return false;
+
+  // Split the predecessors between those along which the accesses are already
+  // redundant, and those at the end of which they need to be checked.
+  bool is_redundant_somewhere = false;
+  for (size_t i = 0; i < preds->second.size(); ++i) {
+    BasicCodeBlock* pred = preds->second[i];
+    GetStateAtExitOf(pred, &state);
+    if (!state.HasNonRedundantAccess(instr)) {
+      is_redundant_somewhere = true;
+      continue;
+    }
+
+    // A check at the end of this predecessor must only precede @p bb.
+    if (pred->successors().size() != 1)
+      return false;
+    if (!pred->instructions().empty() &&
+        (pred->instructions().back().IsCall() ||
+         pred->instructions().back().IsControlFlow())) {
+      return false;
+    }
+    predecessors->push_back(pred);
+  }
+
+  // There's nothing to gain when the accesses aren't redundant along any path.
+  if (!is_redundant_somewhere || predecessors->empty()) {
+    predecessors->clear();
+    return false;
+  }
+
+  return true;
+}
+
+void MemoryAccessAnalysis::ComputePredecessors(
+    const BasicBlockSubGraph* subgraph) {
+  DCHECK(subgraph != NULL);
+
+  predecessors_.clear();
+  pinned_.clear();
+
+  // Entry points are reached from outside of the subgraph.
+  const BasicBlockSubGraph::BlockDescriptionList& descriptions =
+      subgraph->block_descriptions();
+  BasicBlockSubGraph::BlockDescriptionList::const_iterator descr_iter =
+      descriptions.begin();
+  for (; descr_iter != descriptions.end(); ++descr_iter) {
+    if (!descr_iter->basic_block_order.empty())
+      pinned_.insert(descr_iter->basic_block_order.front());
+  }
+
+  BasicBlockSubGraph::BBCollection::const_iterator bb_iter =
+      subgraph->basic_blocks().begin();
+  for (; bb_iter != subgraph->basic_blocks().end(); ++bb_iter) {
+    BasicBlock* bb = *bb_iter;
+
+    // Basic blocks referenced by other blocks.
+    if (!bb->referrers().empty())
+      pinned_.insert(bb);
+
+    // Basic blocks referenced by data, e.g. by a case table.
+    const BasicDataBlock* bb_data = BasicDataBlock::Cast(bb);
+    if (bb_data != NULL) {
+      BasicBlock::BasicBlockReferenceMap::const_iterator ref_iter =
+          bb_data->references().begin();
+      for (; ref_iter != bb_data->references().end(); ++ref_iter) {
+        if (ref_iter->second.basic_block() != NULL)
+          pinned_.insert(ref_iter->second.basic_block());
+      }
+      continue;
+    }
+
+    BasicCodeBlock* bb_code = BasicCodeBlock::Cast(bb);
+    DCHECK(bb_code != NULL);
+
+    // Basic blocks referenced by instructions, e.g. by a computed jump.
+    Instructions::const_iterator inst_iter = bb_code->instructions().begin();
+    for (; inst_iter != bb_code->instructions().end(); ++inst_iter) {
+      BasicBlock::BasicBlockReferenceMap::const_iterator ref_iter =
+          inst_iter->references().begin();
+      for (; ref_iter != inst_iter->references().end(); ++ref_iter) {
+        if (ref_iter->second.basic_block() != NULL)
+          pinned_.insert(ref_iter->second.basic_block());
       }
     }
+
+    // Basic blocks reached by a successor.
+    BasicBlock::Successors::const_iterator succ =
+        bb_code->successors().begin();
+    for (; succ != bb_code->successors().end(); ++succ) {
+      BasicBlock* basic_block = succ->reference().basic_block();
+      if (basic_block != NULL)
+        predecessors_[basic_block].push_back(bb_code);
+    }
   }
 }
 
+void MemoryAccessAnalysis::GetStateAtExitOf(const BasicCodeBlock* bb,
+                                            State* state) const {
+  DCHECK(bb != NULL);
+  DCHECK(state != NULL);
+
+  GetStateAtEntryOf(bb, state);
+  Instructions::const_iterator inst_iter = bb->instructions().begin();
+  for (; inst_iter != bb->instructions().end(); ++inst_iter)
+    PropagateForward(*inst_iter, state);
+}
+
 MemoryAccessAnalysis::State::State() {
 }
 
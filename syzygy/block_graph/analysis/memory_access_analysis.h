@@ -30,6 +30,10 @@
 #ifndef SYZYGY_BLOCK_GRAPH_ANALYSIS_MEMORY_ACCESS_ANALYSIS_H_
 #define SYZYGY_BLOCK_GRAPH_ANALYSIS_MEMORY_ACCESS_ANALYSIS_H_
 
+#include <map>
+#include <set>
+#include <vector>
+
 #include "base/basictypes.h"
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/basic_block_assembler.h"
@@ -38,6 +42,9 @@
 namespace block_graph {
 namespace analysis {
 
+// Forward declaration.
+class ControlFlowAnalysis;
+
 // This class implements a local and a global redundant memory access analysis
 // on a subgraph.
 //
@@ -104,10 +111,29 @@ namespace analysis {
 //    [do something with redundancy information in state...]
 //    liveness.PropagateForward(&instr, &state);
 //  }
+//
+// Partial redundancy
+// ------------------
+//
+// After a global analysis, a memory access which is redundant along some but
+// not all of the paths reaching its basic block may be made fully redundant by
+// checking it at the end of the predecessors along which it is not. This is
+// typically the case of a loop-invariant access in a loop header, which is
+// redundant along the back edge but not along the edge entering the loop.
+//
+// Example:
+//
+//  MemoryAccessAnalysis::BasicCodeBlockVector predecessors;
+//  if (!state.HasNonRedundantAccess(instr)) {
+//    // Redundant memory access.
+//  } else if (memory_access.IsPartiallyRedundant(bb, instr, &predecessors)) {
+//    [check the access at the end of each of predecessors...]
+//  }
 
 class MemoryAccessAnalysis {
  public:
   typedef block_graph::BasicBlockSubGraph BasicBlockSubGraph;
+  typedef std::vector<BasicCodeBlock*> BasicCodeBlockVector;
 
   // Forward declarations.
   class State;
@@ -130,6 +156,29 @@ class MemoryAccessAnalysis {
   // @param subgraph Subgraph to analyze.
   void Analyze(const BasicBlockSubGraph* subgraph);
 
+  // Performs a global analysis using the ordering of a control flow analysis
+  // shared with other analyses of the same subgraph.
+  // @param subgraph Subgraph to analyze.
+  // @param control_flow The control flow analysis of @p subgraph.
+  void Analyze(const BasicBlockSubGraph* subgraph,
+               const ControlFlowAnalysis& control_flow);
+
+  // Determines whether the memory accesses of @p instr, which are not redundant
+  // at @p instr, may be made redundant by checking them at the end of some of
+  // the predecessors of @p bb. This requires that the accesses are performed
+  // on every possible path from the entry of @p bb, using the registers values
+  // at the entry, that they are redundant at the exit of at least one
+  // predecessor of @p bb, and that each other predecessor flows exclusively to
+  // @p bb. This requires a global analysis.
+  // @param bb The basic block containing @p instr.
+  // @param instr The instruction performing the memory accesses.
+  // @param predecessors Receives the predecessors of @p bb at the end of which
+  //     the accesses must be checked.
+  // @returns true if the accesses are partially redundant, false otherwise.
+  bool IsPartiallyRedundant(const BasicCodeBlock* bb,
+                            const Instruction& instr,
+                            BasicCodeBlockVector* predecessors) const;
+
  protected:
   // Perform the intersection of the set of memory accesses in @p state with the
   // the set kept by the analysis for the basic block @p bb. On the first
@@ -137,10 +186,30 @@ class MemoryAccessAnalysis {
   // @p bb and is fully copied.
   bool Intersect(const block_graph::BasicBlock* bb, const State& state);
 
+  // Computes the predecessors of each basic block of @p subgraph, and the set
+  // of basic blocks that may be reached by other means than a successor.
+  // @param subgraph Subgraph to analyze.
+  void ComputePredecessors(const BasicBlockSubGraph* subgraph);
+
+  // Gets the memory accesses done at the exit of a basic block.
+  // @param bb Basic block to analyze.
+  // @param state Receives the set of memory location accessed.
+  void GetStateAtExitOf(const BasicCodeBlock* bb, State* state) const;
+
   // Data structure to keep a set of memory locations for each basic block.
   typedef std::map<const block_graph::BasicBlock*, State> StateMap;
   StateMap states_;
 
+  // The predecessors of each basic block, following the successors.
+  typedef std::map<const block_graph::BasicBlock*, BasicCodeBlockVector>
+      PredecessorMap;
+  PredecessorMap predecessors_;
+
+  // The basic blocks that may be reached by other means than a successor.
+  // These are entry points, or are referenced by instructions, data or other
+  // blocks: not all of their predecessors are known.
+  std::set<const block_graph::BasicBlock*> pinned_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(MemoryAccessAnalysis);
 };
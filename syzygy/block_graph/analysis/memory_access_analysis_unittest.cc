@@ -519,5 +519,95 @@ TEST_F(MemoryAccessAnalysisTest, AnalyzeWithData) {
   EXPECT_TRUE(state_.IsEmpty());
 }
 
+TEST_F(MemoryAccessAnalysisTest, IsPartiallyRedundant) {
+  BasicBlockSubGraph subgraph;
+
+  BlockDescription* block = subgraph.AddBlockDescription(
+      "b1", "b1.obj", BlockGraph::CODE_BLOCK, 7, 2, 42);
+
+  BasicCodeBlock* bb_entry = subgraph.AddBasicCodeBlock("entry");
+  BasicCodeBlock* bb_loop = subgraph.AddBasicCodeBlock("loop");
+  BasicCodeBlock* bb_exit = subgraph.AddBasicCodeBlock("exit");
+
+  ASSERT_TRUE(bb_entry != NULL);
+  ASSERT_TRUE(bb_loop != NULL);
+  ASSERT_TRUE(bb_exit != NULL);
+
+  block->basic_block_order.push_back(bb_entry);
+  block->basic_block_order.push_back(bb_loop);
+  block->basic_block_order.push_back(bb_exit);
+
+  AddSuccessorBetween(Successor::kConditionTrue, bb_entry, bb_loop);
+  AddSuccessorBetween(Successor::kConditionNotEqual, bb_loop, bb_loop);
+  AddSuccessorBetween(Successor::kConditionEqual, bb_loop, bb_exit);
+
+  BasicBlockAssembler asm_entry(bb_entry->instructions().end(),
+                                &bb_entry->instructions());
+  asm_entry.mov(core::ecx, Operand(core::eax, Immediate(1, core::kSize32Bit)));
+
+  // The loop reads [eax + 12] on every iteration, then redefines ecx before
+  // reading [ecx + 24].
+  BasicBlockAssembler asm_loop(bb_loop->instructions().end(),
+                               &bb_loop->instructions());
+  asm_loop.mov(core::edx, Operand(core::eax, Immediate(12, core::kSize32Bit)));
+  asm_loop.mov(core::ecx, Operand(core::eax, Immediate(1, core::kSize32Bit)));
+  asm_loop.mov(core::edx, Operand(core::ecx, Immediate(24, core::kSize32Bit)));
+  ASSERT_EQ(3u, bb_loop->instructions().size());
+  const Instruction& read_eax12 = bb_loop->instructions().front();
+  const Instruction& read_ecx24 = bb_loop->instructions().back();
+
+  BasicBlockAssembler asm_exit(bb_exit->instructions().end(),
+                               &bb_exit->instructions());
+  asm_exit.mov(core::edx, Operand(core::eax, Immediate(12, core::kSize32Bit)));
+  const Instruction& exit_read_eax12 = bb_exit->instructions().front();
+
+  // Without an analysis, nothing is known about the predecessors.
+  MemoryAccessAnalysis::BasicCodeBlockVector predecessors;
+  EXPECT_FALSE(memory_access_.IsPartiallyRedundant(bb_loop, read_eax12,
+                                                   &predecessors));
+  EXPECT_TRUE(predecessors.empty());
+
+  memory_access_.Analyze(&subgraph);
+
+  // The access is not redundant on entry to the loop.
+  GetStateAtEntryOf(bb_loop, &state_);
+  EXPECT_FALSE(state_.Contains(core::eax, 12));
+
+  // But it is loop-invariant, and may be checked in the entry basic block.
+  EXPECT_TRUE(memory_access_.IsPartiallyRedundant(bb_loop, read_eax12,
+                                                  &predecessors));
+  ASSERT_EQ(1u, predecessors.size());
+  EXPECT_EQ(bb_entry, predecessors[0]);
+
+  // The base register of the last access is redefined in the loop.
+  EXPECT_FALSE(memory_access_.IsPartiallyRedundant(bb_loop, read_ecx24,
+                                                   &predecessors));
+  EXPECT_TRUE(predecessors.empty());
+
+  // The access in the exit basic block is already redundant along its single
+  // predecessor.
+  EXPECT_FALSE(memory_access_.IsPartiallyRedundant(bb_exit, exit_read_eax12,
+                                                   &predecessors));
+
+  // A predecessor with more than one successor can't receive the check.
+  AddSuccessorBetween(Successor::kConditionTrue, bb_entry, bb_exit);
+  memory_access_.Analyze(&subgraph);
+  EXPECT_FALSE(memory_access_.IsPartiallyRedundant(bb_loop, read_eax12,
+                                                   &predecessors));
+
+  // Neither can a basic block referenced from outside of the subgraph.
+  bb_entry->successors().pop_back();
+  memory_access_.Analyze(&subgraph);
+  EXPECT_TRUE(memory_access_.IsPartiallyRedundant(bb_loop, read_eax12,
+                                                  &predecessors));
+  BlockGraph block_graph;
+  BlockGraph::Block* external_block =
+      block_graph.AddBlock(BlockGraph::DATA_BLOCK, 4, "external");
+  bb_loop->referrers().insert(BasicBlockReferrer(external_block, 0));
+  memory_access_.Analyze(&subgraph);
+  EXPECT_FALSE(memory_access_.IsPartiallyRedundant(bb_loop, read_eax12,
+                                                   &predecessors));
+}
+
 }  // namespace analysis
 }  // namespace block_graph
@@ -263,6 +263,12 @@ bool Instruction::FromBuffer(const uint8* buf, size_t len, Instruction* inst) {
   return true;
 }
 
+Instruction Instruction::FromRepresentation(const Representation& repr,
+                                            const uint8* buf) {
+  DCHECK(buf != NULL);
+  return Instruction(repr, buf);
+}
+
 const char* Instruction::GetName() const {
   // The mnemonics are defined as NUL terminated unsigned char arrays.
   return reinterpret_cast<char*>(GET_MNEMONIC_NAME(representation_.opcode));
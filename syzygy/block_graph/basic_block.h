@@ -260,6 +260,15 @@ class Instruction {
   // @returns true on success, false otherwise.
   static bool FromBuffer(const uint8* buf, size_t len, Instruction* inst);
 
+  // Factory to construct an Instruction from an already decoded
+  // representation, as produced by FromBuffer.
+  // @param repr the decoded representation of the instruction.
+  // @param buf the data comprising the instruction, of at least @p repr.size
+  //     bytes.
+  // @returns the instruction.
+  static Instruction FromRepresentation(const Representation& repr,
+                                        const uint8* buf);
+
   // Accessors.
   // @{
   const Representation& representation() const { return representation_; }
@@ -154,6 +154,7 @@ BasicBlockDecomposer::BasicBlockDecomposer(const BlockGraph::Block* block,
                                            BasicBlockSubGraph* subgraph)
     : block_(block),
       subgraph_(subgraph),
+      instruction_cache_(NULL),
       current_block_start_(0),
       check_decomposition_results_(true) {
   // TODO(rogerm): Once we're certain this is stable for all input binaries
@@ -203,9 +204,11 @@ bool BasicBlockDecomposer::Decompose() {
   return true;
 }
 
-bool BasicBlockDecomposer::DecodeInstruction(Offset offset,
-                                             Offset code_end_offset,
-                                             Instruction* instruction) const {
+bool BasicBlockDecomposer::DecodeInstruction(
+    Offset offset,
+    Offset code_end_offset,
+    const Instruction::Representation* decoded,
+    Instruction* instruction) const {
   // The entire offset range should fall within the extent of block_ and the
   // output instruction pointer must not be NULL.
   DCHECK_LE(0, offset);
@@ -213,10 +216,13 @@ bool BasicBlockDecomposer::DecodeInstruction(Offset offset,
   DCHECK_LE(static_cast<Size>(code_end_offset), block_->size());
   DCHECK(instruction != NULL);
 
-  // Decode the instruction.
+  // Decode the instruction, unless it was decoded already.
   const uint8* buffer = block_->data() + offset;
   size_t max_length = code_end_offset - offset;
-  if (!Instruction::FromBuffer(buffer, max_length, instruction)) {
+  if (decoded != NULL) {
+    DCHECK_GE(max_length, decoded->size);
+    *instruction = Instruction::FromRepresentation(*decoded, buffer);
+  } else if (!Instruction::FromBuffer(buffer, max_length, instruction)) {
     LOG(ERROR) << "Failed to decode instruction at offset " << offset
                << " of block '" << block_->name() << "'.";
 
@@ -485,14 +491,30 @@ bool BasicBlockDecomposer::ParseInstructions() {
   // Initialize jump_targets_ to include un-discoverable targets.
   InitJumpTargets(code_begin_offset, code_end_offset);
 
+  // Look for the instructions of a previous decomposition of the block.
+  const InstructionCache::Instructions* cached_instructions = NULL;
+  InstructionCache::Instructions decoded_instructions;
+  if (instruction_cache_ != NULL) {
+    cached_instructions = instruction_cache_->Lookup(
+        block_, code_begin_offset, code_end_offset);
+  }
+
   // Disassemble the instruction stream into rudimentary basic blocks.
   Offset offset = code_begin_offset;
   current_block_start_ = offset;
+  size_t instruction_index = 0;
   while (offset < code_end_offset) {
-    // Decode the next instruction.
+    // Decode the next instruction, or get it from the cache.
+    const Instruction::Representation* decoded = NULL;
+    if (cached_instructions != NULL) {
+      DCHECK_LT(instruction_index, cached_instructions->size());
+      decoded = &(*cached_instructions)[instruction_index++];
+    }
     Instruction instruction;
-    if (!DecodeInstruction(offset, code_end_offset, &instruction))
+    if (!DecodeInstruction(offset, code_end_offset, decoded, &instruction))
       return false;
+    if (instruction_cache_ != NULL && cached_instructions == NULL)
+      decoded_instructions.push_back(instruction.representation());
 
     // Handle the decoded instruction.
     if (!HandleInstruction(instruction, offset))
@@ -512,6 +534,11 @@ bool BasicBlockDecomposer::ParseInstructions() {
   if (current_block_start_ != code_end_offset)
     EndCurrentBasicBlock(code_end_offset);
 
+  if (instruction_cache_ != NULL && cached_instructions == NULL) {
+    instruction_cache_->Insert(block_, code_begin_offset, code_end_offset,
+                               &decoded_instructions);
+  }
+
   return true;
 }
 
@@ -33,6 +33,7 @@
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/basic_block_subgraph.h"
 #include "syzygy/block_graph/block_graph.h"
+#include "syzygy/block_graph/instruction_cache.h"
 #include "syzygy/core/address.h"
 #include "syzygy/core/disassembler.h"
 #include "distorm.h"  // NOLINT
@@ -82,6 +83,15 @@ class BasicBlockDecomposer {
   BasicBlockDecomposer(const BlockGraph::Block* block,
                        BasicBlockSubGraph* subgraph);
 
+  // Sets the cache of decoded instructions to use. When a block is decomposed
+  // again while it is unchanged, its instructions are taken from the cache
+  // rather than decoded anew. By default there is no cache.
+  // @param instruction_cache the cache to use, or NULL. It must outlive the
+  //     decomposition.
+  void set_instruction_cache(InstructionCache* instruction_cache) {
+    instruction_cache_ = instruction_cache;
+  }
+
   // Decomposes a function macro block into its constituent basic blocks.
   //
   // Immediately following a successful decomposition of a block to
@@ -154,11 +164,14 @@ class BasicBlockDecomposer {
   // into consideration the range of offsets which denote code.
   // @param offset The offset of into block_ at which to start decoding.
   // @param code_end_offset The offset at which the bytes cease to be code.
+  // @param decoded The cached representation of the instruction, or NULL if
+  //     it must be decoded.
   // @param instruction this value will be populated on success.
   // @returns true on success; false otherwise.
   // @note Used by ParseInstructions().
   bool DecodeInstruction(Offset offset,
                          Offset code_end_offset,
+                         const Instruction::Representation* decoded,
                          Instruction* instruction) const;
 
   // Called for each instruction, this creates the Instruction object
@@ -233,6 +246,9 @@ class BasicBlockDecomposer {
   // The basic-block sub-graph to which the block will be decomposed.
   BasicBlockSubGraph* subgraph_;
 
+  // The cache of decoded instructions, if any.
+  InstructionCache* instruction_cache_;
+
   // The layout of the original block into basic blocks in subgraph_.
   BBAddressSpace original_address_space_;
 
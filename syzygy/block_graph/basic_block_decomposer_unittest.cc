@@ -432,6 +432,69 @@ TEST_F(BasicBlockDecomposerTest, Decompose) {
   }
 }
 
+TEST_F(BasicBlockDecomposerTest, DecomposeWithInstructionCache) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+  InstructionCache cache;
+
+  // The first decomposition populates the cache.
+  BasicBlockSubGraph subgraph1;
+  BasicBlockDecomposer decomposer1(assembly_func_, &subgraph1);
+  decomposer1.set_instruction_cache(&cache);
+  ASSERT_TRUE(decomposer1.Decompose());
+  EXPECT_EQ(1u, cache.size());
+  EXPECT_EQ(0u, cache.hits());
+  EXPECT_EQ(1u, cache.misses());
+
+  // The second one uses it.
+  BasicBlockSubGraph subgraph2;
+  BasicBlockDecomposer decomposer2(assembly_func_, &subgraph2);
+  decomposer2.set_instruction_cache(&cache);
+  ASSERT_TRUE(decomposer2.Decompose());
+  EXPECT_EQ(1u, cache.hits());
+  EXPECT_EQ(1u, cache.misses());
+
+  // Both decompositions must be identical.
+  ASSERT_EQ(1u, subgraph1.block_descriptions().size());
+  ASSERT_EQ(1u, subgraph2.block_descriptions().size());
+  const BasicBlockSubGraph::BasicBlockOrdering& order1 =
+      subgraph1.block_descriptions().back().basic_block_order;
+  const BasicBlockSubGraph::BasicBlockOrdering& order2 =
+      subgraph2.block_descriptions().back().basic_block_order;
+  ASSERT_EQ(order1.size(), order2.size());
+  BasicBlockSubGraph::BasicBlockOrdering::const_iterator it1 = order1.begin();
+  BasicBlockSubGraph::BasicBlockOrdering::const_iterator it2 = order2.begin();
+  for (; it1 != order1.end(); ++it1, ++it2) {
+    ASSERT_EQ((*it1)->type(), (*it2)->type());
+    EXPECT_EQ((*it1)->offset(), (*it2)->offset());
+
+    const BasicCodeBlock* code1 = BasicCodeBlock::Cast(*it1);
+    const BasicCodeBlock* code2 = BasicCodeBlock::Cast(*it2);
+    if (code1 == NULL)
+      continue;
+    ASSERT_EQ(code1->instructions().size(), code2->instructions().size());
+    BasicBlock::Instructions::const_iterator inst1 =
+        code1->instructions().begin();
+    BasicBlock::Instructions::const_iterator inst2 =
+        code2->instructions().begin();
+    for (; inst1 != code1->instructions().end(); ++inst1, ++inst2) {
+      EXPECT_EQ(inst1->opcode(), inst2->opcode());
+      ASSERT_EQ(inst1->size(), inst2->size());
+      EXPECT_EQ(0, ::memcmp(inst1->data(), inst2->data(), inst1->size()));
+      EXPECT_EQ(inst1->references().size(), inst2->references().size());
+    }
+  }
+
+  // Modifying the block invalidates its entry.
+  assembly_func_->GetMutableData();
+  BasicBlockSubGraph subgraph3;
+  BasicBlockDecomposer decomposer3(assembly_func_, &subgraph3);
+  decomposer3.set_instruction_cache(&cache);
+  ASSERT_TRUE(decomposer3.Decompose());
+  EXPECT_EQ(1u, cache.hits());
+  EXPECT_EQ(2u, cache.misses());
+  EXPECT_EQ(1u, cache.size());
+}
+
 TEST_F(BasicBlockDecomposerTest, DecomposeBlockWithLabelPastData) {
   ASSERT_NO_FATAL_FAILURE(InitBasicBlockSubGraphWithLabelPastEnd());
 }
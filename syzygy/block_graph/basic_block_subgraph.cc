@@ -17,8 +17,7 @@
 #include "syzygy/block_graph/basic_block_subgraph.h"
 
 #include <algorithm>
-
-#include "base/memory/scoped_ptr.h"
+#include <new>
 
 namespace block_graph {
 
@@ -42,10 +41,11 @@ BasicBlockSubGraph::BasicBlockSubGraph()
 }
 
 BasicBlockSubGraph::~BasicBlockSubGraph() {
-  // Delete all the BB's we've been entrusted with.
+  // Destroy all the BB's we've been entrusted with. Their memory is released
+  // along with the arena.
   BBCollection::iterator it = basic_blocks_.begin();
   for (; it != basic_blocks_.end(); ++it)
-    delete *it;
+    (*it)->~BasicBlock();
 
   // And wipe the collection.
   basic_blocks_.clear();
@@ -73,11 +73,12 @@ block_graph::BasicCodeBlock* BasicBlockSubGraph::AddBasicCodeBlock(
     const base::StringPiece& name) {
   DCHECK(!name.empty());
 
-  scoped_ptr<BasicCodeBlock> new_code_block(new BasicCodeBlock(this, name));
-  bool inserted = basic_blocks_.insert(new_code_block.get()).second;
+  BasicCodeBlock* new_code_block =
+      new(arena_.Allocate(sizeof(BasicCodeBlock))) BasicCodeBlock(this, name);
+  bool inserted = basic_blocks_.insert(new_code_block).second;
   DCHECK(inserted);
 
-  return new_code_block.release();
+  return new_code_block;
 }
 
 block_graph::BasicDataBlock* BasicBlockSubGraph::AddBasicDataBlock(
@@ -86,18 +87,20 @@ block_graph::BasicDataBlock* BasicBlockSubGraph::AddBasicDataBlock(
     const uint8* data) {
   DCHECK(!name.empty());
 
-  scoped_ptr<BasicDataBlock> new_data_block(
-      new BasicDataBlock(this, name, data, size));
-  bool inserted = basic_blocks_.insert(new_data_block.get()).second;
+  BasicDataBlock* new_data_block =
+      new(arena_.Allocate(sizeof(BasicDataBlock))) BasicDataBlock(
+          this, name, data, size);
+  bool inserted = basic_blocks_.insert(new_data_block).second;
   DCHECK(inserted);
 
-  return new_data_block.release();
+  return new_data_block;
 }
 
 void BasicBlockSubGraph::Remove(BasicBlock* bb) {
   DCHECK(basic_blocks_.find(bb) != basic_blocks_.end());
 
   basic_blocks_.erase(bb);
+  bb->~BasicBlock();
 }
 
 bool BasicBlockSubGraph::IsValid() const {
@@ -25,6 +25,7 @@
 #include "base/string_piece.h"
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/block_graph.h"
+#include "syzygy/core/arena.h"
 
 namespace block_graph {
 
@@ -35,7 +36,9 @@ namespace block_graph {
 //
 // In manipulating the basic block sub-graph, note that the sub-graph
 // acts as a basic-block factory and retains ownership of all basic-blocks
-// that participate in the composition.
+// that participate in the composition. The basic-blocks are allocated from
+// an arena owned by the sub-graph, and their memory is released all at once
+// along with it.
 class BasicBlockSubGraph {
  public:
   typedef block_graph::BasicBlock BasicBlock;
@@ -121,7 +124,7 @@ class BasicBlockSubGraph {
                                     Size size,
                                     const uint8* data);
 
-  // Remove a basic block from the subgraph.
+  // Remove a basic block from the subgraph, and destroy it.
   // @param bb The basic block to remove.
   // @pre @p bb must be in the graph.
   void Remove(BasicBlock* bb);
@@ -158,6 +161,9 @@ class BasicBlockSubGraph {
   // is optional, and may be NULL.
   const Block* original_block_;
 
+  // The arena the basic blocks are allocated from. This must outlive them.
+  core::Arena arena_;
+
   // The set of basic blocks in this sub-graph. This includes any basic-blocks
   // created during the initial decomposition process, as well as any additional
   // basic-blocks synthesized thereafter.
@@ -96,6 +96,26 @@ TEST(BasicBlockSubGraphTest, AddBasicBlock) {
   ASSERT_NE(implicit_cast<BasicBlock*>(bb2), bb3);
 }
 
+TEST(BasicBlockSubGraphTest, RemoveBasicBlock) {
+  BasicBlockSubGraph subgraph;
+
+  BasicCodeBlock* bb1 = subgraph.AddBasicCodeBlock("bb1");
+  BasicDataBlock* bb2 = subgraph.AddBasicDataBlock("bb2", kDataSize, kData);
+  ASSERT_TRUE(bb1 != NULL);
+  ASSERT_TRUE(bb2 != NULL);
+  EXPECT_EQ(2u, subgraph.basic_blocks().size());
+
+  subgraph.Remove(bb1);
+  ASSERT_EQ(1u, subgraph.basic_blocks().size());
+  EXPECT_EQ(bb2, *subgraph.basic_blocks().begin());
+
+  // New basic blocks can still be added.
+  BasicCodeBlock* bb3 = subgraph.AddBasicCodeBlock("bb3");
+  ASSERT_TRUE(bb3 != NULL);
+  EXPECT_EQ("bb3", bb3->name());
+  EXPECT_EQ(2u, subgraph.basic_blocks().size());
+}
+
 TEST(BasicBlockSubGraphTest, AddBlockDescription) {
   TestBasicBlockSubGraph subgraph;
   BlockDescription* b1 = subgraph.AddBlockDescription(
@@ -168,6 +168,16 @@ class MergeContext {
   typedef std::map<const BasicBlock*, BasicBlockLayoutInfo>
       BasicBlockLayoutInfoMap;
 
+  // A short intra-block successor whose size is still being relaxed.
+  struct PendingSuccessor {
+    // The layout info of the basic block the successor belongs to.
+    BasicBlockLayoutInfo* info;
+    // The index of the successor in info->successors.
+    size_t index;
+    // The layout info of the successor's destination.
+    const BasicBlockLayoutInfo* dest;
+  };
+
   // Update the new block with the source range for the bytes in the
   // range [new_offset, new_offset + new_size).
   // @param source_range The source range (if any) to assign.
@@ -220,11 +230,13 @@ class MergeContext {
   // @param block The destination block for this ordering.
   bool InitializeBlockLayout(const BasicBlockOrdering& order, Block* block);
 
-  // Generates a layout for @p order. This layout will arrange each basic block
-  // in the ordering back-to-back with minimal reach encodings on each
-  // successor, while respecting basic block alignments.
-  // @param order The basic block ordering to process.
-  bool GenerateBlockLayout(const BasicBlockOrdering& order);
+  // Generates a layout for each of the orderings in @p subgraph. This layout
+  // will arrange each basic block in its ordering back-to-back with minimal
+  // reach encodings on each successor, while respecting basic block
+  // alignments. Successors are relaxed over all of the orderings at once.
+  // @param subgraph The subgraph whose orderings are to be processed.
+  // @pre InitializeBlockLayout has succeeded for each of the orderings.
+  bool GenerateBlockLayouts(const BasicBlockSubGraph& subgraph);
 
   // Generates a layout for @p subgraph and stores it in layout_info_.
   // @param subgraph The subgraph to process.
@@ -250,15 +262,6 @@ class MergeContext {
   // Returns the maximal successor size for @p condition.
   static Size GetLongSuccessorSize(Successor::Condition condition);
 
-  // Computes and returns the required successor size for @p successor.
-  // @param info The layout info for the basic block.
-  // @param start_offset Offset from the start of @p info.basic_block to
-  //     the first byte of the successor.
-  // @param successor The successor to size.
-  Size ComputeRequiredSuccessorSize(const BasicBlockLayoutInfo& info,
-                                    Offset start_offset,
-                                    const SuccessorLayoutInfo& successor);
-
   // Finds the layout info for a given basic block.
   // @param bb The basic block whose layout info is desired.
   BasicBlockLayoutInfo& FindLayoutInfo(const BasicBlock* bb);
@@ -709,80 +712,116 @@ bool MergeContext::InitializeBlockLayout(const BasicBlockOrdering& order,
   return true;
 }
 
-bool MergeContext::GenerateBlockLayout(const BasicBlockOrdering& order) {
-  BasicBlockOrderingConstIter it = order.begin();
+bool MergeContext::GenerateBlockLayouts(const BasicBlockSubGraph& subgraph) {
+  // Gather the layout info of each non-empty ordering, so that the passes
+  // below don't need to go through the layout info map. At the same time,
+  // size each manifested successor. Successors that leave their block are
+  // always long, while those that stay within it start out short and are
+  // queued for relaxation.
+  std::vector<std::vector<BasicBlockLayoutInfo*> > orderings;
+  std::vector<PendingSuccessor> pending;
+  BlockDescriptionConstIter desc_it = subgraph.block_descriptions().begin();
+  for (; desc_it != subgraph.block_descriptions().end(); ++desc_it) {
+    const BasicBlockOrdering& order = desc_it->basic_block_order;
+    if (order.empty())
+      continue;
 
-  // Loop over the layout, expanding successors until stable.
-  while (true) {
-    bool expanded_successor = false;
+    orderings.push_back(std::vector<BasicBlockLayoutInfo*>());
+    std::vector<BasicBlockLayoutInfo*>& infos = orderings.back();
+    infos.reserve(order.size());
 
-    // Update the start offset for each of the BBs, respecting the BB alignment
-    // constraints.
-    it = order.begin();
-    Offset next_block_start = 0;
-    Block* new_block = NULL;
+    BasicBlockOrderingConstIter it = order.begin();
     for (; it != order.end(); ++it) {
       BasicBlockLayoutInfo& info = FindLayoutInfo(*it);
-      next_block_start = common::AlignUp(next_block_start,
-                                         info.basic_block->alignment());
-      info.start_offset = next_block_start;
-
-      if (new_block == NULL)
-        new_block = info.block;
-      DCHECK(new_block == info.block);
-
-      next_block_start += info.basic_block_size +
-                          info.successors[0].size +
-                          info.successors[1].size;
-    }
-
-    // See whether there's a need to expand the successor sizes.
-    it = order.begin();
-    for (; it != order.end(); ++it) {
-      const BasicBlock* bb = *it;
-      BasicBlockLayoutInfo& info = FindLayoutInfo(bb);
+      DCHECK(infos.empty() || infos.front()->block == info.block);
+      infos.push_back(&info);
 
-      // Compute the start offset for this block's first successor.
-      Offset start_offset = info.start_offset + info.basic_block_size;
       for (size_t i = 0; i < arraysize(info.successors); ++i) {
         SuccessorLayoutInfo& successor = info.successors[i];
 
-        // Exit the loop if this (and possibly the subsequent) successor
-        // is un-manifested.
-        if (successor.condition == Successor::kInvalidCondition &&
-            successor.successor == NULL) {
-          break;
-        }
-
-        // Skip over elided successors.
-        DCHECK_NE(reinterpret_cast<Successor*>(NULL), successor.successor);
+        // Skip over unused and elided successors.
         if (successor.condition == Successor::kInvalidCondition)
           continue;
 
-        // Compute the new size and update the start offset for the next
-        // successor (if any).
-        Size new_size =
-            ComputeRequiredSuccessorSize(info, start_offset, successor);
-        start_offset += new_size;
-
-        // Check whether we're expanding this successor.
-        if (new_size != successor.size) {
-          DCHECK_LT(successor.size, new_size);
-          successor.size = new_size;
-          expanded_successor = true;
+        const BasicBlockLayoutInfo* dest = NULL;
+        if (successor.reference.referred_type() ==
+                BasicBlockReference::REFERRED_TYPE_BASIC_BLOCK) {
+          dest = &FindLayoutInfo(successor.reference.basic_block());
+        } else {
+          DCHECK_EQ(BasicBlockReference::REFERRED_TYPE_BLOCK,
+                    successor.reference.referred_type());
         }
+
+        if (dest == NULL || dest->block != info.block) {
+          successor.size = GetLongSuccessorSize(successor.condition);
+          continue;
+        }
+
+        successor.size = GetShortSuccessorSize(successor.condition);
+        PendingSuccessor entry = { &info, i, dest };
+        pending.push_back(entry);
       }
     }
+  }
 
-    if (!expanded_successor) {
-      // We've achieved a stable layout and we know that next_block_start
-      // is the size of the new block, so resize it and allocate the data now.
-      new_block->set_size(next_block_start);
-      new_block->AllocateData(next_block_start);
+  // Alternate between laying out the blocks and widening the short successors
+  // that are out of reach. As successors only ever grow, any successor that
+  // has been widened is settled and drops out of the pending set, and the
+  // loop stops on the first pass that widens nothing.
+  std::vector<Size> block_sizes(orderings.size());
+  while (true) {
+    // Update the start offset for each of the BBs, respecting the BB alignment
+    // constraints.
+    for (size_t i = 0; i < orderings.size(); ++i) {
+      Offset next_block_start = 0;
+      for (size_t j = 0; j < orderings[i].size(); ++j) {
+        BasicBlockLayoutInfo& info = *orderings[i][j];
+        next_block_start = common::AlignUp(next_block_start,
+                                           info.basic_block->alignment());
+        info.start_offset = next_block_start;
+        next_block_start += info.basic_block_size +
+                            info.successors[0].size +
+                            info.successors[1].size;
+      }
+      block_sizes[i] = next_block_start;
+    }
 
-      return true;
+    // Widen the pending successors whose destination is out of short reach,
+    // compacting the remainder to the front of the pending set.
+    size_t remaining = 0;
+    for (size_t i = 0; i < pending.size(); ++i) {
+      const PendingSuccessor& entry = pending[i];
+      SuccessorLayoutInfo& successor = entry.info->successors[entry.index];
+
+      Offset end_offset = entry.info->start_offset +
+          entry.info->basic_block_size + successor.size;
+      if (entry.index == 1)
+        end_offset += entry.info->successors[0].size;
+      Offset displacement = entry.dest->start_offset - end_offset;
+
+      if (displacement <= std::numeric_limits<int8>::max() &&
+          displacement >= std::numeric_limits<int8>::min()) {
+        pending[remaining++] = entry;
+        continue;
+      }
+
+      successor.size = GetLongSuccessorSize(successor.condition);
     }
+
+    if (remaining == pending.size())
+      break;
+    pending.resize(remaining);
   }
+
+  // We've achieved a stable layout and we know the size of each of the new
+  // blocks, so resize them and allocate their data now.
+  for (size_t i = 0; i < orderings.size(); ++i) {
+    Block* new_block = orderings[i].front()->block;
+    new_block->set_size(block_sizes[i]);
+    new_block->AllocateData(block_sizes[i]);
+  }
+
+  return true;
 }
 
 bool MergeContext::GenerateLayout(const BasicBlockSubGraph& subgraph) {
@@ -819,21 +858,10 @@ bool MergeContext::GenerateLayout(const BasicBlockSubGraph& subgraph) {
     }
   }
 
-  // Now generate a layout for each ordering.
-  it = subgraph.block_descriptions().begin();
-  for (; it != subgraph.block_descriptions().end(); ++it) {
-    const BlockDescription& description = *it;
-
-    // Skip the block if it's empty.
-    if (description.basic_block_order.empty())
-      continue;
-
-    // Generate the layout for this block.
-    if (!GenerateBlockLayout(description.basic_block_order)) {
-      LOG(ERROR) << "Failed to generate a layout for basic block '" <<
-          description.name << "'";
-      return false;
-    }
+  // Now generate a layout for all of the orderings.
+  if (!GenerateBlockLayouts(subgraph)) {
+    LOG(ERROR) << "Failed to generate a layout for the subgraph.";
+    return false;
   }
 
   return true;
@@ -1047,42 +1075,6 @@ Size MergeContext::GetLongSuccessorSize(Successor::Condition condition) {
   }
 }
 
-Size MergeContext::ComputeRequiredSuccessorSize(
-    const BasicBlockLayoutInfo& info,
-    Offset start_offset,
-    const SuccessorLayoutInfo& successor) {
-  switch (successor.reference.referred_type()) {
-    case BasicBlockReference::REFERRED_TYPE_BLOCK:
-      return GetLongSuccessorSize(successor.condition);
-
-    case BasicBlockReference::REFERRED_TYPE_BASIC_BLOCK: {
-        Size short_size = GetShortSuccessorSize(successor.condition);
-        const BasicBlock* dest_bb = successor.reference.basic_block();
-        DCHECK_NE(reinterpret_cast<BasicBlock*>(NULL), dest_bb);
-        const BasicBlockLayoutInfo& dest = FindLayoutInfo(dest_bb);
-
-        // If the destination is within the same destination block,
-        // let's see if we can use a short reach here.
-        if (info.block == dest.block) {
-          Offset destination_offset =
-              dest.start_offset - (start_offset + short_size);
-
-          // Are we in-bounds for a short reference?
-          if (destination_offset <= std::numeric_limits<int8>::max() &&
-              destination_offset >= std::numeric_limits<int8>::min()) {
-            return short_size;
-          }
-        }
-
-        return GetLongSuccessorSize(successor.condition);
-      }
-
-    default:
-      NOTREACHED() << "Impossible Successor reference type.";
-      return 0;
-  }
-}
-
 MergeContext::BasicBlockLayoutInfo& MergeContext::FindLayoutInfo(
     const BasicBlock* bb) {
   BasicBlockLayoutInfoMap::iterator it = layout_info_.find(bb);
@@ -444,6 +444,39 @@ TEST_F(BlockBuilderTest, OutofReachJmpLayout) {
   EXPECT_EQ(expected_refs, new_block->references());
 }
 
+TEST_F(BlockBuilderTest, CascadingOutofReachLayout) {
+  // With all successors short, the BB1->BB4 branch is out of reach by 5 bytes,
+  // while the BB2->BB1 jump is just in reach at -126 bytes. Widening the
+  // branch pushes the jump out of reach in turn.
+  Block* new_block = CreateLayout(62, 60, 70, 1);
+  ASSERT_TRUE(new_block != NULL);
+
+  size_t expected_size = 62 +
+                         core::AssemblerImpl::kLongBranchSize +
+                         60 +
+                         core::AssemblerImpl::kLongJumpSize +
+                         70 +
+                         1;
+  EXPECT_EQ(expected_size, new_block->size());
+  Block::ReferenceMap expected_refs;
+  expected_refs.insert(
+      std::make_pair(62 + core::AssemblerImpl::kLongBranchOpcodeSize,
+                     Reference(BlockGraph::PC_RELATIVE_REF,
+                               4,
+                               new_block,
+                               expected_size - 1,
+                               expected_size - 1)));
+  size_t succ_location = 62 +
+                         core::AssemblerImpl::kLongBranchSize +
+                         60 +
+                         core::AssemblerImpl::kLongJumpOpcodeSize;
+  expected_refs.insert(
+      std::make_pair(succ_location,
+                     Reference(BlockGraph::PC_RELATIVE_REF,
+                               4, new_block, 0, 0)));
+  EXPECT_EQ(expected_refs, new_block->references());
+}
+
 TEST_F(BlockBuilderTest, MergeAssemblesSourceRangesCorrectly) {
   ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
   ASSERT_NO_FATAL_FAILURE(InitBasicBlockSubGraph());
@@ -14,6 +14,7 @@
 
 #include "syzygy/block_graph/block_graph.h"
 
+#include <algorithm>
 #include <limits>
 
 #include "base/logging.h"
@@ -34,45 +35,67 @@ const char* kBlockType[] = {
 COMPILE_ASSERT(arraysize(kBlockType) == BlockGraph::BLOCK_TYPE_MAX,
                kBlockType_not_in_sync);
 
+// The size of the slabs owned block data is carved out of.
+const size_t kDataSlabSize = 1024 * 1024;
+
+// The estimated per-element overhead of the containers of a block, beyond
+// the size of the elements themselves.
+#if defined(SYZYGY_FLAT_BLOCK_CONTAINERS)
+const size_t kContainerNodeSize = 0;
+#else
+// The left, right and parent pointers and the color of a tree node.
+const size_t kContainerNodeSize = 4 * sizeof(void*);
+#endif
+
+// The estimated per-block overhead of the block map.
+#if defined(SYZYGY_DENSE_BLOCK_MAP)
+const size_t kBlockMapNodeSize = 0;
+#else
+const size_t kBlockMapNodeSize = 4 * sizeof(void*);
+#endif
+
+// Returns the size of the slab allocation holding @p size bytes of data.
+size_t GetDataSlabAllocationSize(size_t size) {
+  size_t slab_size = common::AlignUp(size, core::Arena::kAlignment);
+  if (slab_size == 0)
+    slab_size = core::Arena::kAlignment;
+  return slab_size;
+}
+
+// Adds @p counts to @p total.
+void AddMemoryCounts(const BlockGraph::MemoryStatistics::Counts& counts,
+                     BlockGraph::MemoryStatistics::Counts* total) {
+  DCHECK(total != NULL);
+  total->block_count += counts.block_count;
+  total->block_size += counts.block_size;
+  total->owned_data_size += counts.owned_data_size;
+  total->unowned_data_size += counts.unowned_data_size;
+}
+
 // Shift all items in an offset -> item map by 'distance', provided the initial
 // item offset was >= @p offset.
-template<typename ItemType>
+template<typename ItemMap>
 void ShiftOffsetItemMap(BlockGraph::Offset offset,
                         BlockGraph::Offset distance,
-                        std::map<BlockGraph::Offset, ItemType>* items) {
+                        ItemMap* items) {
   DCHECK_GE(offset, 0);
   DCHECK_NE(distance, 0);
   DCHECK(items != NULL);
 
-  typedef std::map<BlockGraph::Offset, ItemType> ItemMap;
-
-  // Get iterators to all of the items that need changing.
-  std::vector<ItemMap::iterator> item_its;
-  ItemMap::iterator item_it = items->lower_bound(offset);
-  while (item_it != items->end()) {
-    item_its.push_back(item_it);
-    ++item_it;
-  }
-
-  // Get the direction and bounds of the iteration. We need to walk through
-  // the iterators in a different order depending on if we're shifting left
-  // or right. This is to ensure that earlier shifts don't land on the values
-  // of later unshifted offsets.
-  int start = 0;
-  int stop = item_its.size();
-  int step = 1;
-  if (distance > 0) {
-    start = stop - 1;
-    stop = -1;
-    step = -1;
-  }
-
-  for (int i = start; i != stop; i += step) {
-    item_it = item_its[i];
-    items->insert(std::make_pair(item_it->first + distance,
-                                 item_it->second));
-    items->erase(item_it);
+  typedef std::pair<BlockGraph::Offset, typename ItemMap::mapped_type> Item;
+
+  // Pull out all of the items that need changing and reinsert them at their
+  // shifted offsets. Doing this in bulk means that earlier shifts can't land
+  // on the values of later unshifted offsets, and works equally well for node
+  // based and flat maps.
+  typename ItemMap::iterator item_it = items->lower_bound(offset);
+  std::vector<Item> shifted_items;
+  for (; item_it != items->end(); ++item_it) {
+    shifted_items.push_back(std::make_pair(item_it->first + distance,
+                                           item_it->second));
   }
+  items->erase(items->lower_bound(offset), items->end());
+  items->insert(shifted_items.begin(), shifted_items.end());
 }
 
 void ShiftReferences(BlockGraph::Block* block,
@@ -126,39 +149,41 @@ void ShiftReferrers(BlockGraph::Block* self,
   typedef BlockGraph::Block::ReferrerSet ReferrerSet;
   typedef BlockGraph::Reference Reference;
 
-  ReferrerSet::iterator ref_it = referrers->begin();
-  while (ref_it != referrers->end()) {
-    // We need to keep around the next iterator as 'ref_it' will be invalidated
-    // if we need to update the reference. (It will be deleted and then
-    // recreated.)
-    ReferrerSet::iterator next_ref_it = ref_it;
-    ++next_ref_it;
-
+  // Updating the references of other blocks doesn't modify our referrer set,
+  // as the referrers are left pointing at this block. Thus it is safe to
+  // iterate over it directly.
+  ReferrerSet::const_iterator ref_it = referrers->begin();
+  for (; ref_it != referrers->end(); ++ref_it) {
     BlockGraph::Block* ref_block = ref_it->first;
     // Our own references will have been moved already.
-    if (ref_block != self) {
-      BlockGraph::Offset ref_offset = ref_it->second;
-
-      Reference ref;
-      bool ref_found = ref_block->GetReference(ref_offset, &ref);
-      DCHECK(ref_found);
-
-      // Shift the reference if need be.
-      if (ref.offset() >= offset) {
-        Reference new_ref(ref.type(),
-                          ref.size(),
-                          ref.referenced(),
-                          ref.offset() + distance,
-                          ref.base() + distance);
-        bool inserted = ref_block->SetReference(ref_offset, new_ref);
-        DCHECK(!inserted);
-      }
-    }
+    if (ref_block == self)
+      continue;
+
+    BlockGraph::Offset ref_offset = ref_it->second;
 
-    ref_it = next_ref_it;
+    Reference ref;
+    bool ref_found = ref_block->GetReference(ref_offset, &ref);
+    DCHECK(ref_found);
+
+    // Shift the reference if need be.
+    if (ref.offset() >= offset) {
+      Reference new_ref(ref.type(),
+                        ref.size(),
+                        ref.referenced(),
+                        ref.offset() + distance,
+                        ref.base() + distance);
+      bool inserted = ref_block->SetReference(ref_offset, new_ref);
+      DCHECK(!inserted);
+    }
   }
 }
 
+// Orders pending references by their source block and offset.
+bool PendingReferenceSourceLess(const BlockGraph::PendingReference& ref1,
+                                const BlockGraph::PendingReference& ref2) {
+  return ref1.first < ref2.first;
+}
+
 const char* BlockAttributeToString(BlockGraph::BlockAttributeEnum attr) {
   switch (attr) {
 #define DEFINE_CASE(name) case BlockGraph::name: return #name;
@@ -214,10 +239,155 @@ const BlockGraph::SectionId BlockGraph::kInvalidSectionId = -1;
 
 BlockGraph::BlockGraph()
     : next_section_id_(0),
-      next_block_id_(0) {
+      next_block_id_(0),
+      use_data_slabs_(false),
+      data_slabs_(kDataSlabSize),
+      free_data_size_(0) {
 }
 
 BlockGraph::~BlockGraph() {
+  // The blocks give their data back to the block-graph, so they must go
+  // first.
+  blocks_.clear();
+}
+
+bool BlockGraph::set_use_data_slabs(bool use_data_slabs) {
+  if (use_data_slabs == use_data_slabs_)
+    return true;
+
+  if (!blocks_.empty()) {
+    LOG(ERROR) << "Unable to change the data allocation of a non-empty "
+               << "block-graph.";
+    return false;
+  }
+
+  use_data_slabs_ = use_data_slabs;
+  return true;
+}
+
+void BlockGraph::GetMemoryStatistics(MemoryStatistics* stats) const {
+  DCHECK(stats != NULL);
+
+  *stats = MemoryStatistics();
+  BlockMap::const_iterator it = blocks_.begin();
+  for (; it != blocks_.end(); ++it) {
+    const Block& block = it->second;
+
+    MemoryStatistics::Counts counts;
+    counts.block_count = 1;
+    counts.block_size = kBlockMapNodeSize + sizeof(BlockMap::value_type) +
+        block.references().size() *
+            (kContainerNodeSize + sizeof(Block::ReferenceMap::value_type)) +
+        block.referrers().size() *
+            (kContainerNodeSize + sizeof(Block::ReferrerSet::value_type)) +
+        block.labels().size() *
+            (kContainerNodeSize + sizeof(Block::LabelMap::value_type)) +
+        block.source_ranges().size() *
+            sizeof(Block::SourceRanges::RangePair);
+    if (block.owns_data()) {
+      counts.owned_data_size = block.data_size();
+    } else {
+      counts.unowned_data_size = block.data_size();
+    }
+
+    AddMemoryCounts(counts, &stats->total);
+    DCHECK_GT(BLOCK_TYPE_MAX, block.type());
+    AddMemoryCounts(counts, &stats->by_type[block.type()]);
+    AddMemoryCounts(counts, &stats->by_section[block.section()]);
+  }
+
+  if (use_data_slabs_)
+    stats->data_slab_size = data_slabs_.reserved_size();
+  stats->free_data_size = free_data_size_;
+}
+
+bool BlockGraph::CreateSnapshot(BlockGraph* snapshot) const {
+  DCHECK(snapshot != NULL);
+  DCHECK_NE(this, snapshot);
+
+  if (!snapshot->sections_.empty() || !snapshot->blocks_.empty()) {
+    LOG(ERROR) << "Can only snapshot into an empty block-graph.";
+    return false;
+  }
+
+  snapshot->sections_ = sections_;
+  snapshot->next_section_id_ = next_section_id_;
+  snapshot->next_block_id_ = next_block_id_;
+
+  // Copy the blocks, keeping their ids, and sharing their data.
+  BlockMap::const_iterator it = blocks_.begin();
+  for (; it != blocks_.end(); ++it) {
+    const Block& block = it->second;
+    Block& copy = snapshot->blocks_.insert(std::make_pair(
+        block.id(),
+        Block(block.id(), block.type(), block.size(), block.name(),
+              snapshot))).first->second;
+    copy.alignment_ = block.alignment_;
+    if (block.compiland_name_ != NULL)
+      copy.set_compiland_name(*block.compiland_name_);
+    copy.addr_ = block.addr_;
+    copy.section_ = block.section_;
+    copy.attributes_ = block.attributes_;
+    copy.source_ranges_ = block.source_ranges_;
+    copy.labels_ = block.labels_;
+    if (block.data_ != NULL)
+      copy.SetData(block.data_, block.data_size_);
+  }
+
+  // The references are rebuilt in one batch, as they must refer to the blocks
+  // of the snapshot.
+  PendingReferences references;
+  for (it = blocks_.begin(); it != blocks_.end(); ++it) {
+    const Block& block = it->second;
+    if (block.references_.empty())
+      continue;
+
+    Block* source = snapshot->GetBlockById(block.id());
+    DCHECK(source != NULL);
+    Block::ReferenceMap::const_iterator ref_it = block.references_.begin();
+    for (; ref_it != block.references_.end(); ++ref_it) {
+      const Reference& ref = ref_it->second;
+      Block* referenced = snapshot->GetBlockById(ref.referenced()->id());
+      DCHECK(referenced != NULL);
+      references.push_back(std::make_pair(
+          std::make_pair(source, ref_it->first),
+          Reference(ref.type(), ref.size(), referenced, ref.offset(),
+                    ref.base())));
+    }
+  }
+  snapshot->SetReferences(&references);
+
+  return true;
+}
+
+uint8* BlockGraph::AllocateBlockData(size_t size) {
+  if (!use_data_slabs_)
+    return new uint8[size];
+
+  // Recycle a freed allocation of the same size if there is one.
+  size_t slab_size = GetDataSlabAllocationSize(size);
+  FreeDataMap::iterator it = free_data_.find(slab_size);
+  if (it != free_data_.end() && !it->second.empty()) {
+    uint8* data = it->second.back();
+    it->second.pop_back();
+    free_data_size_ -= slab_size;
+    return data;
+  }
+
+  return reinterpret_cast<uint8*>(data_slabs_.Allocate(slab_size));
+}
+
+void BlockGraph::FreeBlockData(uint8* data, size_t size) {
+  DCHECK(data != NULL);
+
+  if (!use_data_slabs_) {
+    delete [] data;
+    return;
+  }
+
+  size_t slab_size = GetDataSlabAllocationSize(size);
+  free_data_[slab_size].push_back(data);
+  free_data_size_ += slab_size;
 }
 
 BlockGraph::Section* BlockGraph::AddSection(const base::StringPiece& name,
@@ -345,6 +515,67 @@ const BlockGraph::Block* BlockGraph::GetBlockById(BlockId id) const {
   return &it->second;
 }
 
+void BlockGraph::SetReferences(PendingReferences* references) {
+  DCHECK(references != NULL);
+
+  // Group the references by source. The sort is stable so that the last of
+  // several references at the same source remains the last one.
+  std::stable_sort(references->begin(), references->end(),
+                   &PendingReferenceSourceLess);
+
+  // The back-references to create, keyed by the referenced block.
+  typedef std::pair<Block*, Block::Referrer> PendingReferrer;
+  std::vector<PendingReferrer> referrers;
+  referrers.reserve(references->size());
+
+  // Insert the references of each source block in one go.
+  std::vector<std::pair<Offset, Reference> > block_references;
+  PendingReferences::const_iterator it = references->begin();
+  while (it != references->end()) {
+    Block* block = it->first.first;
+    DCHECK(block != NULL);
+    DCHECK_EQ(this, block->block_graph_);
+
+    block_references.clear();
+    for (; it != references->end() && it->first.first == block; ++it) {
+      // Skip references that are overridden later in the batch.
+      PendingReferences::const_iterator next = it + 1;
+      if (next != references->end() && next->first == it->first)
+        continue;
+
+      Offset offset = it->first.second;
+      const Reference& ref = it->second;
+      DCHECK(ref.IsValid());
+
+      // Overriding an existing reference means patching up the referrers of
+      // the block it used to point to, which SetReference takes care of.
+      if (block->references_.find(offset) != block->references_.end()) {
+        block->SetReference(offset, ref);
+        continue;
+      }
+
+      block_references.push_back(std::make_pair(offset, ref));
+      referrers.push_back(
+          std::make_pair(ref.referenced(), Block::Referrer(block, offset)));
+    }
+    block->references_.insert(block_references.begin(),
+                              block_references.end());
+  }
+
+  // Record the back-references, once again one referenced block at a time.
+  std::sort(referrers.begin(), referrers.end());
+  std::vector<Block::Referrer> block_referrers;
+  std::vector<PendingReferrer>::const_iterator ref_it = referrers.begin();
+  while (ref_it != referrers.end()) {
+    Block* referenced = ref_it->first;
+    block_referrers.clear();
+    for (; ref_it != referrers.end() && ref_it->first == referenced; ++ref_it)
+      block_referrers.push_back(ref_it->second);
+    referenced->referrers_.insert(block_referrers.begin(),
+                                  block_referrers.end());
+  }
+}
+
 bool BlockGraph::RemoveBlockByIterator(BlockMap::iterator it) {
   DCHECK(it != blocks_.end());
 
@@ -717,7 +948,8 @@ BlockGraph::Block::Block(BlockGraph* block_graph)
       attributes_(0),
       owns_data_(false),
       data_(NULL),
-      data_size_(0) {
+      data_size_(0),
+      data_version_(0) {
   DCHECK(block_graph != NULL);
 }
 
@@ -738,7 +970,8 @@ BlockGraph::Block::Block(BlockId id,
       attributes_(0),
       owns_data_(false),
       data_(NULL),
-      data_size_(0) {
+      data_size_(0),
+      data_version_(0) {
   DCHECK(block_graph != NULL);
   set_name(name);
 }
@@ -746,7 +979,7 @@ BlockGraph::Block::Block(BlockId id,
 BlockGraph::Block::~Block() {
   DCHECK(block_graph_ != NULL);
   if (owns_data_)
-    delete [] data_;
+    block_graph_->FreeBlockData(const_cast<uint8*>(data_), data_size_);
 }
 
 void BlockGraph::Block::set_name(const base::StringPiece& name) {
@@ -774,18 +1007,19 @@ uint8* BlockGraph::Block::AllocateRawData(size_t data_size) {
   DCHECK_GT(data_size, 0u);
   DCHECK_LE(data_size, size_);
 
-  uint8* new_data = new uint8[data_size];
+  uint8* new_data = block_graph_->AllocateBlockData(data_size);
   if (!new_data)
     return NULL;
 
   if (owns_data()) {
     DCHECK(data_ != NULL);
-    delete [] data_;
+    block_graph_->FreeBlockData(const_cast<uint8*>(data_), data_size_);
   }
 
   data_ = new_data;
   data_size_ = data_size;
   owns_data_ = true;
+  ++data_version_;
 
   return new_data;
 }
@@ -921,11 +1155,12 @@ void BlockGraph::Block::SetData(const uint8* data, size_t data_size) {
   DCHECK(data_size <= size_);
 
   if (owns_data_)
-    delete [] data_;
+    block_graph_->FreeBlockData(const_cast<uint8*>(data_), data_size_);
 
   owns_data_ = false;
   data_ = data;
   data_size_ = data_size;
+  ++data_version_;
 }
 
 uint8* BlockGraph::Block::AllocateData(size_t size) {
@@ -950,12 +1185,14 @@ const uint8* BlockGraph::Block::ResizeData(size_t new_size) {
   if (new_size == data_size_)
     return data_;
 
+  ++data_version_;
+
   if (!owns_data() && new_size < data_size_) {
     // Not in our ownership and shrinking. We only need to adjust our length.
     data_size_ = new_size;
   } else {
     // Either our own data, or it's growing (or both). We need to reallocate.
-    uint8* new_data = new uint8[new_size];
+    uint8* new_data = block_graph_->AllocateBlockData(new_size);
     if (new_data == NULL)
       return NULL;
 
@@ -967,7 +1204,7 @@ const uint8* BlockGraph::Block::ResizeData(size_t new_size) {
     }
 
     if (owns_data())
-      delete [] data_;
+      block_graph_->FreeBlockData(const_cast<uint8*>(data_), data_size_);
 
     owns_data_ = true;
     data_ = new_data;
@@ -983,7 +1220,7 @@ uint8* BlockGraph::Block::GetMutableData() {
 
   // Make a copy if we don't already own the data.
   if (!owns_data()) {
-    uint8* new_data = new uint8[data_size_];
+    uint8* new_data = block_graph_->AllocateBlockData(data_size_);
     if (new_data == NULL)
       return NULL;
     memcpy(new_data, data_, data_size_);
@@ -991,6 +1228,7 @@ uint8* BlockGraph::Block::GetMutableData() {
     owns_data_ = true;
   }
   DCHECK(owns_data_);
+  ++data_version_;
 
   return const_cast<uint8*>(data_);
 }
@@ -1057,14 +1295,20 @@ bool BlockGraph::Block::SetReference(Offset offset, const Reference& ref) {
   ReferenceMap::iterator it(references_.find(offset));
   bool inserted = false;
   if (it != references_.end()) {
-    // Erase the back reference.
     BlockGraph::Block* referenced = it->second.referenced();
-    Referrer referrer(this, offset);
-    size_t removed = referenced->referrers_.erase(referrer);
-    DCHECK_EQ(1U, removed);
 
     // Lastly switch the reference.
     it->second = ref;
+
+    // If the reference still points to the same block then the back
+    // reference is already in place.
+    if (referenced == ref.referenced())
+      return false;
+
+    // Erase the back reference.
+    Referrer referrer(this, offset);
+    size_t removed = referenced->referrers_.erase(referrer);
+    DCHECK_EQ(1U, removed);
   } else {
     // It's a new reference, insert it.
     inserted = references_.insert(std::make_pair(offset, ref)).second;
@@ -1104,24 +1348,22 @@ bool BlockGraph::Block::RemoveReference(Offset offset) {
 }
 
 bool BlockGraph::Block::RemoveAllReferences() {
-  ReferenceMap::iterator it = references_.begin();
-  while (it != references_.end()) {
-    ReferenceMap::iterator to_remove = it;
-    ++it;
-
+  ReferenceMap::const_iterator it = references_.begin();
+  for (; it != references_.end(); ++it) {
     // TODO(rogerm): As an optimization, we don't need to drop intra-block
     //     references when disconnecting from the block_graph. Consider having
     //     BlockGraph::RemoveBlockByIterator() check that the block has no
     //     external referrers before calling this function and erasing the
     //     block.
 
-    // Unregister this reference from the referred block then erase it.
-    BlockGraph::Block* referenced = to_remove->second.referenced();
-    Referrer referrer(this, to_remove->first);
+    // Unregister this reference from the referred block. As self-references
+    // only modify our referrers, this doesn't invalidate our iterator.
+    BlockGraph::Block* referenced = it->second.referenced();
+    Referrer referrer(this, it->first);
     size_t removed = referenced->referrers_.erase(referrer);
     DCHECK_EQ(1U, removed);
-    references_.erase(to_remove);
   }
+  references_.clear();
 
   return true;
 }
@@ -41,8 +41,12 @@
         'filter_util.h',
         'filterable.cc',
         'filterable.h',
+        'instruction_cache.cc',
+        'instruction_cache.h',
         'iterate.cc',
         'iterate.h',
+        'lazy_block_graph_loader.cc',
+        'lazy_block_graph_loader.h',
         'ordered_block_graph.cc',
         'ordered_block_graph.h',
         'ordered_block_graph_internal.h',
@@ -94,7 +98,9 @@
         'block_util_unittest.cc',
         'filter_util_unittest.cc',
         'filterable_unittest.cc',
+        'instruction_cache_unittest.cc',
         'iterate_unittest.cc',
+        'lazy_block_graph_loader_unittest.cc',
         'ordered_block_graph_unittest.cc',
         'transform_unittest.cc',
         'typed_block_unittest.cc',
@@ -36,6 +36,9 @@
 #include "syzygy/common/align.h"
 #include "syzygy/core/address.h"
 #include "syzygy/core/address_space.h"
+#include "syzygy/core/arena.h"
+#include "syzygy/core/dense_id_map.h"
+#include "syzygy/core/flat_map.h"
 #include "syzygy/core/string_table.h"
 
 namespace block_graph {
@@ -226,7 +229,24 @@ class BlockGraph {
   class Reference;
 
   // The block map contains all blocks, indexed by id.
+  //
+  // When SYZYGY_DENSE_BLOCK_MAP is defined the blocks are stored in chunked
+  // vectors indexed by id, which makes lookups by id O(1) and sweeps over all
+  // blocks sequential. The blocks never move, and the iteration order is the
+  // same, but the memory of removed blocks is only reclaimed with the graph.
+#if defined(SYZYGY_DENSE_BLOCK_MAP)
+  typedef core::DenseIdMap<BlockId, Block> BlockMap;
+#else
   typedef std::map<BlockId, Block> BlockMap;
+#endif
+
+  // A reference to be created by SetReferences, keyed by its source block and
+  // the offset of the reference in that block.
+  typedef std::pair<std::pair<Block*, Offset>, Reference> PendingReference;
+  typedef std::vector<PendingReference> PendingReferences;
+
+  // An estimate of the memory used by the blocks of the graph.
+  struct MemoryStatistics;
 
   BlockGraph();
   ~BlockGraph();
@@ -316,10 +336,51 @@ class BlockGraph {
   const Block* GetBlockById(BlockId id) const;
   // @}
 
+  // Sets a batch of references. This is equivalent to calling
+  // Block::SetReference for each of them in turn, but it inserts the
+  // references and referrers of each block in one pass. This is much cheaper
+  // when building all of the references of an image, particularly when the
+  // blocks use flat storage (see SYZYGY_FLAT_BLOCK_CONTAINERS).
+  // @param references the references to set. This is reordered in place.
+  // @note As with repeated calls to SetReference, the last reference set at
+  //     any given source offset wins.
+  void SetReferences(PendingReferences* references);
+
   // Get the string table.
   // @returns the string table of this BlockGraph.
   core::StringTable& string_table() { return string_table_; }
 
+  // Sets whether the data owned by blocks is carved out of large slabs
+  // tracked by the block-graph, rather than allocated individually on the
+  // heap. Slabs are only released along with the block-graph; data freed in
+  // the meantime is recycled for later allocations of the same size. This can
+  // only be changed while the block-graph has no blocks.
+  // @param use_data_slabs true to allocate owned data from slabs.
+  // @returns true on success, false if the block-graph already has blocks.
+  bool set_use_data_slabs(bool use_data_slabs);
+
+  // @returns true if owned block data is allocated from slabs.
+  bool use_data_slabs() const { return use_data_slabs_; }
+
+  // Estimates the memory used by the blocks of the graph, by block type and
+  // by section. This walks all of the blocks.
+  // @param stats receives the statistics.
+  void GetMemoryStatistics(MemoryStatistics* stats) const;
+
+  // Creates a copy-on-write snapshot of this block-graph, for instance to
+  // evaluate several transforms or orderings of one decomposition. The
+  // snapshot has the same sections, and blocks with the same ids and
+  // properties, referring to each other in the same way. Its blocks don't
+  // copy the data of this graph's blocks, but refer to it until they first
+  // modify it, at which point they get a copy of their own as blocks
+  // referring to the data of an image do. Only the data of the modified
+  // blocks is duplicated, and snapshots may be modified concurrently.
+  // @param snapshot the empty block-graph receiving the snapshot.
+  // @returns true on success, false if @p snapshot isn't empty.
+  // @note The data of this graph's blocks must outlive the snapshot and must
+  //     not be modified while the snapshot refers to it.
+  bool CreateSnapshot(BlockGraph* snapshot) const;
+
  private:
   // Give BlockGraphSerializer access to our innards for serialization.
   friend BlockGraphSerializer;
@@ -341,6 +402,73 @@ class BlockGraph {
 
   // A string table used to intern strings.
   core::StringTable string_table_;
+
+  // @name Allocation of the data owned by blocks.
+  // @{
+  // Allocates a data buffer for a block.
+  // @param size the size of the buffer, in bytes.
+  // @returns the buffer.
+  uint8* AllocateBlockData(size_t size);
+
+  // Frees a data buffer allocated by AllocateBlockData.
+  // @param data the buffer to free.
+  // @param size the size of @p data, as passed to AllocateBlockData.
+  void FreeBlockData(uint8* data, size_t size);
+  // @}
+
+  // True if owned block data is carved out of data_slabs_.
+  bool use_data_slabs_;
+
+  // The slabs owned block data is carved out of, when use_data_slabs_ is
+  // true.
+  core::Arena data_slabs_;
+
+  // The freed slab allocations, keyed by their aligned size, for reuse.
+  typedef std::map<size_t, std::vector<uint8*> > FreeDataMap;
+  FreeDataMap free_data_;
+
+  // The total size of the buffers in free_data_.
+  size_t free_data_size_;
+};
+
+// The statistics returned by BlockGraph::GetMemoryStatistics. Sizes are in
+// bytes, and the sizes of the containers of the blocks are estimates.
+struct BlockGraph::MemoryStatistics {
+  // The memory used by a group of blocks.
+  struct Counts {
+    Counts() : block_count(0), block_size(0), owned_data_size(0),
+               unowned_data_size(0) {
+    }
+
+    // The number of blocks.
+    size_t block_count;
+    // The size of the blocks themselves, along with their references,
+    // referrers, labels and source ranges.
+    size_t block_size;
+    // The size of the data owned by the blocks.
+    size_t owned_data_size;
+    // The size of the data referred to by the blocks but owned elsewhere,
+    // typically by the original image.
+    size_t unowned_data_size;
+  };
+  typedef std::map<SectionId, Counts> SectionCountsMap;
+
+  MemoryStatistics() : data_slab_size(0), free_data_size(0) {
+  }
+
+  // The memory used by all of the blocks.
+  Counts total;
+  // The memory used by the blocks of each type.
+  Counts by_type[BLOCK_TYPE_MAX];
+  // The memory used by the blocks of each section. Blocks that don't belong
+  // to any section are counted under kInvalidSectionId.
+  SectionCountsMap by_section;
+
+  // The total size of the slabs owned data is carved out of. This is zero
+  // unless slabs are in use.
+  size_t data_slab_size;
+  // The size of the freed slab allocations awaiting reuse.
+  size_t free_data_size;
 };
 
 // The BlockGraph maintains a list of sections, and each block belongs
@@ -518,11 +646,24 @@ class BlockGraph::Block {
   // This is keyed on block and source offset (not destination offset),
   // to allow one to easily locate and remove the backreferences on change or
   // deletion.
+  //
+  // When SYZYGY_FLAT_BLOCK_CONTAINERS is defined the referrers, references and
+  // labels of a block are stored in sorted vectors rather than node based
+  // containers. These are more compact and faster to search and iterate, but
+  // any modification invalidates all iterators into them.
   typedef std::pair<Block*, Offset> Referrer;
+#if defined(SYZYGY_FLAT_BLOCK_CONTAINERS)
+  typedef core::FlatSet<Referrer> ReferrerSet;
+#else
   typedef std::set<Referrer> ReferrerSet;
+#endif
 
   // Map of references that this block makes to other blocks.
+#if defined(SYZYGY_FLAT_BLOCK_CONTAINERS)
+  typedef core::FlatMap<Offset, Reference> ReferenceMap;
+#else
   typedef std::map<Offset, Reference> ReferenceMap;
+#endif
 
   // Represents a range of data in this block.
   typedef core::AddressRange<Offset, Size> DataRange;
@@ -545,7 +686,11 @@ class BlockGraph::Block {
   // within the block. Note that, while possible, it is NOT guaranteed that
   // all basic blocks are marked with a label. Basic block decomposition should
   // disassemble from the code labels to discover all basic blocks.
+#if defined(SYZYGY_FLAT_BLOCK_CONTAINERS)
+  typedef core::FlatMap<Offset, Label> LabelMap;
+#else
   typedef std::map<Offset, Label> LabelMap;
+#endif
 
   ~Block();
 
@@ -670,8 +815,15 @@ class BlockGraph::Block {
 
   // Returns a mutable copy of the block's data. If the block doesn't own
   // the data on entry, it'll be copied and the copy returned to the caller.
+  // This counts as a modification of the data; the pointer shouldn't be kept
+  // for writing later on.
   uint8* GetMutableData();
 
+  // @returns a counter that changes each time the data of the block is set,
+  //     reallocated, resized or handed out for modification. This lets
+  //     information derived from the data be cached.
+  uint32 data_version() const { return data_version_; }
+
   // The data bytes the block refers to.
   const uint8* data() const { return data_; }
 
@@ -810,6 +962,8 @@ class BlockGraph::Block {
   const uint8* data_;
   // Size of the above.
   size_t data_size_;
+  // Incremented each time the data may have been modified.
+  uint32 data_version_;
 };
 
 // A graph address space endows a graph with a non-overlapping ordering
@@ -14,6 +14,8 @@
 
 #include "syzygy/block_graph/block_graph_serializer.h"
 
+#include <iterator>
+
 #include "base/stringprintf.h"
 
 namespace block_graph {
@@ -94,6 +96,16 @@ bool BlockGraphSerializer::Save(const BlockGraph& block_graph,
   if (!SaveBlockGraphProperties(block_graph, out_archive))
     return false;
 
+  // Save the blocks and their references as separate records, preceded by an
+  // index of their sizes, so that they can be loaded lazily.
+  if (has_attributes(BLOCK_INDEX)) {
+    if (!SaveIndexedBlocks(block_graph, out_archive)) {
+      LOG(ERROR) << "Unable to save indexed blocks.";
+      return false;
+    }
+    return true;
+  }
+
   // Save the blocks, except for their references. We do that in a second pass
   // so that when loading the referenced blocks will exist.
   if (!SaveBlocks(block_graph, out_archive)) {
@@ -115,6 +127,45 @@ bool BlockGraphSerializer::Load(BlockGraph* block_graph,
   CHECK(block_graph != NULL);
   CHECK(in_archive != NULL);
 
+  // These functions take care of outputting a meaningful log message on
+  // failure.
+  if (!LoadHeader(in_archive) ||
+      !LoadBlockGraphProperties(block_graph, in_archive)) {
+    return false;
+  }
+
+  // Load the blocks, except for their references.
+  if (has_attributes(BLOCK_INDEX)) {
+    // The block records follow the index, in order.
+    BlockIndex index;
+    if (!LoadBlockIndex(&index, in_archive)) {
+      LOG(ERROR) << "Unable to load block index.";
+      return false;
+    }
+    for (size_t i = 0; i < index.size(); ++i) {
+      if (!LoadBlock(block_graph, index[i].id, in_archive)) {
+        LOG(ERROR) << "Unable to load block " << i << " of " << index.size()
+                   << " with id " << index[i].id << ".";
+        return false;
+      }
+    }
+  } else if (!LoadBlocks(block_graph, in_archive)) {
+    LOG(ERROR) << "Unable to load blocks.";
+    return false;
+  }
+
+  // Now load the references and wire them up.
+  if (!LoadBlockGraphReferences(block_graph, in_archive)) {
+    LOG(ERROR) << "Unable to load block graph references.";
+    return false;
+  }
+
+  return true;
+}
+
+bool BlockGraphSerializer::LoadHeader(InArchive* in_archive) {
+  DCHECK(in_archive != NULL);
+
   uint32 version = 0;
   if (!in_archive->Load(&version)) {
     LOG(ERROR) << "Unable to load serialized block graph version.";
@@ -145,23 +196,6 @@ bool BlockGraphSerializer::Load(BlockGraph* block_graph,
     return false;
   }
 
-  // This function takes care of outputting a meaningful log message on
-  // failure.
-  if (!LoadBlockGraphProperties(block_graph, in_archive))
-    return false;
-
-  // Load the blocks, except for their references.
-  if (!LoadBlocks(block_graph, in_archive)) {
-    LOG(ERROR) << "Unable to load blocks.";
-    return false;
-  }
-
-  // Now load the references and wire them up.
-  if (!LoadBlockGraphReferences(block_graph, in_archive)) {
-    LOG(ERROR) << "Unable to load block graph references.";
-    return false;
-  }
-
   return true;
 }
 
@@ -204,17 +238,30 @@ bool BlockGraphSerializer::SaveBlocks(const BlockGraph& block_graph,
                                       OutArchive* out_archive) const {
   DCHECK(out_archive != NULL);
 
-  if (!out_archive->Save(block_graph.blocks().size())) {
+  if (!SaveCount(block_graph.blocks().size(), out_archive)) {
     LOG(ERROR) << "Unable to save block count.";
     return false;
   }
 
   // Output the basic block properties first.
+  BlockGraph::BlockId previous_id = 0;
   BlockGraph::BlockMap::const_iterator it = block_graph.blocks_.begin();
   for (; it != block_graph.blocks_.end(); ++it) {
     BlockGraph::BlockId block_id = it->first;
     const BlockGraph::Block& block = it->second;
-    if (!out_archive->Save(block_id) ||
+
+    // The blocks are sorted by ID, so the difference from the previous one is
+    // never negative.
+    bool id_saved = false;
+    if (has_attributes(DELTA_ENCODING)) {
+      DCHECK_LE(previous_id, block_id);
+      id_saved = SaveUint32(block_id - previous_id, out_archive);
+      previous_id = block_id;
+    } else {
+      id_saved = out_archive->Save(block_id);
+    }
+
+    if (!id_saved ||
         !SaveBlockProperties(block, out_archive) ||
         !SaveBlockLabels(block, out_archive) ||
         !SaveBlockData(block, out_archive)) {
@@ -234,32 +281,31 @@ bool BlockGraphSerializer::LoadBlocks(BlockGraph* block_graph,
   DCHECK_EQ(0u, block_graph->blocks_.size());
 
   size_t count = 0;
-  if (!in_archive->Load(&count)) {
+  if (!LoadCount(&count, in_archive)) {
     LOG(ERROR) << "Unable to load block count.";
     return false;
   }
 
+  BlockGraph::BlockId previous_id = 0;
   for (size_t i = 0; i < count; ++i) {
     BlockGraph::BlockId id = 0;
-    if (!in_archive->Load(&id)) {
-      LOG(ERROR) << "Unable to load id for block " << i << " of " << count
-                 << ".";
-      return false;
+    bool id_loaded = false;
+    if (has_attributes(DELTA_ENCODING)) {
+      uint32 id_delta = 0;
+      id_loaded = LoadUint32(&id_delta, in_archive);
+      id = previous_id + id_delta;
+      previous_id = id;
+    } else {
+      id_loaded = in_archive->Load(&id);
     }
 
-    std::pair<BlockGraph::BlockMap::iterator, bool> result =
-        block_graph->blocks_.insert(
-            std::make_pair(id, BlockGraph::Block(block_graph)));
-    if (!result.second) {
-      LOG(ERROR) << "Unable to insert block with id " << id << ".";
+    if (!id_loaded) {
+      LOG(ERROR) << "Unable to load id for block " << i << " of " << count
+                 << ".";
       return false;
     }
-    BlockGraph::Block* block = &result.first->second;
-    block->id_ = id;
 
-    if (!LoadBlockProperties(block, in_archive) ||
-        !LoadBlockLabels(block, in_archive) ||
-        !LoadBlockData(block, in_archive)) {
+    if (!LoadBlock(block_graph, id, in_archive)) {
       LOG(ERROR) << "Unable to load block " << i << " of " << count
                  << " with id " << id << ".";
       return false;
@@ -270,6 +316,145 @@ bool BlockGraphSerializer::LoadBlocks(BlockGraph* block_graph,
   return true;
 }
 
+bool BlockGraphSerializer::SaveIndexedBlocks(const BlockGraph& block_graph,
+                                             OutArchive* out_archive) const {
+  DCHECK(out_archive != NULL);
+
+  // Serialize the blocks and their references to separate buffers, keeping
+  // track of the size of each record.
+  std::vector<uint8> blocks_buffer;
+  scoped_ptr<core::OutStream> blocks_stream(
+      core::CreateByteOutStream(std::back_inserter(blocks_buffer)));
+  OutArchive blocks_archive(blocks_stream.get());
+
+  std::vector<uint8> references_buffer;
+  scoped_ptr<core::OutStream> references_stream(
+      core::CreateByteOutStream(std::back_inserter(references_buffer)));
+  OutArchive references_archive(references_stream.get());
+
+  BlockIndex index;
+  index.reserve(block_graph.blocks().size());
+  BlockGraph::BlockMap::const_iterator it = block_graph.blocks().begin();
+  for (; it != block_graph.blocks().end(); ++it) {
+    const BlockGraph::Block& block = it->second;
+    size_t blocks_start = blocks_buffer.size();
+    size_t references_start = references_buffer.size();
+    if (!SaveBlockProperties(block, &blocks_archive) ||
+        !SaveBlockLabels(block, &blocks_archive) ||
+        !SaveBlockData(block, &blocks_archive) ||
+        !SaveBlockReferences(block, &references_archive)) {
+      LOG(ERROR) << "Unable to save block with id " << it->first << ".";
+      return false;
+    }
+
+    BlockIndexEntry entry;
+    entry.id = it->first;
+    entry.block_size = blocks_buffer.size() - blocks_start;
+    entry.references_size = references_buffer.size() - references_start;
+    index.push_back(entry);
+  }
+
+  // Save the index.
+  if (!SaveCount(index.size(), out_archive)) {
+    LOG(ERROR) << "Unable to save block count.";
+    return false;
+  }
+  BlockGraph::BlockId previous_id = 0;
+  for (size_t i = 0; i < index.size(); ++i) {
+    bool id_saved = false;
+    if (has_attributes(DELTA_ENCODING)) {
+      DCHECK_LE(previous_id, index[i].id);
+      id_saved = SaveUint32(index[i].id - previous_id, out_archive);
+      previous_id = index[i].id;
+    } else {
+      id_saved = out_archive->Save(index[i].id);
+    }
+
+    if (!id_saved ||
+        !SaveUint32(index[i].block_size, out_archive) ||
+        !SaveUint32(index[i].references_size, out_archive)) {
+      LOG(ERROR) << "Unable to save index entry for block with id "
+                 << index[i].id << ".";
+      return false;
+    }
+  }
+
+  // Then the records.
+  if ((!blocks_buffer.empty() &&
+       !out_archive->out_stream()->Write(blocks_buffer.size(),
+                                         blocks_buffer.data())) ||
+      (!references_buffer.empty() &&
+       !out_archive->out_stream()->Write(references_buffer.size(),
+                                         references_buffer.data()))) {
+    LOG(ERROR) << "Unable to save block records.";
+    return false;
+  }
+
+  return true;
+}
+
+bool BlockGraphSerializer::LoadBlockIndex(BlockIndex* index,
+                                          InArchive* in_archive) const {
+  DCHECK(index != NULL);
+  DCHECK(in_archive != NULL);
+
+  size_t count = 0;
+  if (!LoadCount(&count, in_archive)) {
+    LOG(ERROR) << "Unable to load block count.";
+    return false;
+  }
+
+  index->resize(count);
+  BlockGraph::BlockId previous_id = 0;
+  for (size_t i = 0; i < count; ++i) {
+    BlockIndexEntry& entry = index->at(i);
+    bool id_loaded = false;
+    if (has_attributes(DELTA_ENCODING)) {
+      uint32 id_delta = 0;
+      id_loaded = LoadUint32(&id_delta, in_archive);
+      entry.id = previous_id + id_delta;
+      previous_id = entry.id;
+    } else {
+      id_loaded = in_archive->Load(&entry.id);
+    }
+
+    if (!id_loaded ||
+        !LoadUint32(&entry.block_size, in_archive) ||
+        !LoadUint32(&entry.references_size, in_archive)) {
+      LOG(ERROR) << "Unable to load index entry " << i << " of " << count
+                 << ".";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool BlockGraphSerializer::LoadBlock(BlockGraph* block_graph,
+                                     BlockGraph::BlockId id,
+                                     InArchive* in_archive) const {
+  DCHECK(block_graph != NULL);
+  DCHECK(in_archive != NULL);
+
+  std::pair<BlockGraph::BlockMap::iterator, bool> result =
+      block_graph->blocks_.insert(
+          std::make_pair(id, BlockGraph::Block(block_graph)));
+  if (!result.second) {
+    LOG(ERROR) << "Unable to insert block with id " << id << ".";
+    return false;
+  }
+  BlockGraph::Block* block = &result.first->second;
+  block->id_ = id;
+
+  if (!LoadBlockProperties(block, in_archive) ||
+      !LoadBlockLabels(block, in_archive) ||
+      !LoadBlockData(block, in_archive)) {
+    return false;
+  }
+
+  return true;
+}
+
 bool BlockGraphSerializer::SaveBlockGraphReferences(
     const BlockGraph& block_graph, OutArchive* out_archive) const {
   DCHECK(out_archive != NULL);
@@ -395,6 +580,7 @@ bool BlockGraphSerializer::SaveBlockLabels(const BlockGraph::Block& block,
     return false;
   }
 
+  int32 previous_offset = 0;
   BlockGraph::Block::LabelMap::const_iterator label_iter =
       block.labels().begin();
   for (; label_iter != block.labels().end(); ++label_iter) {
@@ -405,7 +591,16 @@ bool BlockGraphSerializer::SaveBlockLabels(const BlockGraph::Block& block,
     const BlockGraph::Label& label = label_iter->second;
     uint16 attributes = static_cast<uint16>(label.attributes());
 
-    if (!SaveInt32(offset, out_archive) || !out_archive->Save(attributes) ||
+    // The labels are sorted by offset, so with delta encoding we save the
+    // distance from the previous label.
+    int32 saved_offset = offset;
+    if (has_attributes(DELTA_ENCODING)) {
+      saved_offset = offset - previous_offset;
+      previous_offset = offset;
+    }
+
+    if (!SaveInt32(saved_offset, out_archive) ||
+        !out_archive->Save(attributes) ||
         !MaybeSaveString(*this, label.name(), out_archive)) {
       LOG(ERROR) << "Unable to save label at offset "
                  << label_iter->first << " of block with id "
@@ -434,6 +629,7 @@ bool BlockGraphSerializer::LoadBlockLabels(BlockGraph::Block* block,
     return false;
   }
 
+  int32 previous_offset = 0;
   for (size_t i = 0; i < label_count; ++i) {
     int32 offset = 0;
     uint16 attributes = 0;
@@ -446,6 +642,11 @@ bool BlockGraphSerializer::LoadBlockLabels(BlockGraph::Block* block,
       return false;
     }
 
+    if (has_attributes(DELTA_ENCODING)) {
+      offset += previous_offset;
+      previous_offset = offset;
+    }
+
     // Ensure the attributes are valid.
     if (!ValidAttributes(attributes, BlockGraph::LABEL_ATTRIBUTES_MAX)) {
       LOG(ERROR) << "Invalid attributes ("
@@ -630,19 +831,30 @@ bool BlockGraphSerializer::LoadBlockData(BlockGraph::Block* block,
 bool BlockGraphSerializer::SaveBlockReferences(const BlockGraph::Block& block,
                                                OutArchive* out_archive) const {
   // Output the number of references for this block.
-  if (!out_archive->Save(block.references().size())) {
+  if (!SaveCount(block.references().size(), out_archive)) {
     LOG(ERROR) << "Unable to save reference count for block with id "
                << block.id() << ".";
     return false;
   }
 
-  // Output the references as (offset, reference) pairs.
+  // Output the references as (offset, reference) pairs. With delta encoding
+  // the offsets are relative to the previous reference, and the referenced
+  // blocks are relative to the previously referenced block, starting with the
+  // referring block itself.
+  int32 previous_offset = 0;
+  BlockGraph::BlockId previous_id = block.id();
   BlockGraph::Block::ReferenceMap::const_iterator it =
       block.references().begin();
   for (; it != block.references().end(); ++it) {
     int32 offset = it->first;
-    if (!SaveInt32(offset, out_archive) ||
-        !SaveReference(it->second, out_archive)) {
+    int32 saved_offset = offset;
+    if (has_attributes(DELTA_ENCODING)) {
+      saved_offset = offset - previous_offset;
+      previous_offset = offset;
+    }
+
+    if (!SaveInt32(saved_offset, out_archive) ||
+        !SaveReference(it->second, &previous_id, out_archive)) {
       LOG(ERROR) << "Unable to save (offset, reference) pair at offset "
                  << offset << " of block with id " << block.id() << ".";
       return false;
@@ -663,23 +875,30 @@ bool BlockGraphSerializer::LoadBlockReferences(BlockGraph* block_graph,
   DCHECK_EQ(0u, block->references().size());
 
   size_t count = 0;
-  if (!in_archive->Load(&count)) {
+  if (!LoadCount(&count, in_archive)) {
     LOG(ERROR) << "Unable to load reference count for block with id "
                << block->id() << ".";
     return false;
   }
 
+  int32 previous_offset = 0;
+  BlockGraph::BlockId previous_id = block->id();
   for (size_t i = 0; i < count; ++i) {
     int32 offset = 0;
     BlockGraph::Reference ref;
     if (!LoadInt32(&offset, in_archive) ||
-        !LoadReference(block_graph, &ref, in_archive)) {
+        !LoadReference(block_graph, &ref, &previous_id, in_archive)) {
       LOG(ERROR) << "Unable to load (offset, reference) pair " << i << " of "
                  << count << " for block with id " << block->id() << ".";
       return false;
     }
     DCHECK(ref.referenced() != NULL);
 
+    if (has_attributes(DELTA_ENCODING)) {
+      offset += previous_offset;
+      previous_offset = offset;
+    }
+
     if (!block->SetReference(offset, ref)) {
       LOG(ERROR) << "Unable to create block reference at offset " << offset
                  << " of block with id " << block->id() << ".";
@@ -691,8 +910,10 @@ bool BlockGraphSerializer::LoadBlockReferences(BlockGraph* block_graph,
 }
 
 bool BlockGraphSerializer::SaveReference(const BlockGraph::Reference& ref,
+                                         BlockGraph::BlockId* previous_id,
                                          OutArchive* out_archive) const {
   DCHECK(ref.referenced() != NULL);
+  DCHECK(previous_id != NULL);
   DCHECK(out_archive != NULL);
 
   COMPILE_ASSERT(BlockGraph::REFERENCE_TYPE_MAX < 16,
@@ -708,9 +929,24 @@ bool BlockGraphSerializer::SaveReference(const BlockGraph::Reference& ref,
   // the base as a difference from the offset to encourage smaller values.
   int32 base_delta = ref.base() - ref.offset();
 
-  if (!out_archive->Save(type_size) ||
-      !out_archive->Save(ref.referenced()->id()) ||
-      !SaveInt32(offset, out_archive) || !SaveInt32(base_delta, out_archive)) {
+  if (!out_archive->Save(type_size)) {
+    LOG(ERROR) << "Unable to write reference properties.";
+    return false;
+  }
+
+  // References tend to target the same few blocks, so with delta encoding we
+  // save the referenced block relative to the previous one.
+  BlockGraph::BlockId id = ref.referenced()->id();
+  bool id_saved = false;
+  if (has_attributes(DELTA_ENCODING)) {
+    id_saved = SaveInt32(static_cast<int32>(id - *previous_id), out_archive);
+    *previous_id = id;
+  } else {
+    id_saved = out_archive->Save(id);
+  }
+
+  if (!id_saved || !SaveInt32(offset, out_archive) ||
+      !SaveInt32(base_delta, out_archive)) {
     LOG(ERROR) << "Unable to write reference properties.";
     return false;
   }
@@ -720,9 +956,11 @@ bool BlockGraphSerializer::SaveReference(const BlockGraph::Reference& ref,
 
 bool BlockGraphSerializer::LoadReference(BlockGraph* block_graph,
                                          BlockGraph::Reference* ref,
+                                         BlockGraph::BlockId* previous_id,
                                          InArchive* in_archive) const {
   DCHECK(block_graph != NULL);
   DCHECK(ref != NULL);
+  DCHECK(previous_id != NULL);
   DCHECK(in_archive != NULL);
 
   uint8 type_size = 0;
@@ -730,8 +968,20 @@ bool BlockGraphSerializer::LoadReference(BlockGraph* block_graph,
   int32 offset = 0;
   int32 base_delta = 0;
 
-  if (!in_archive->Load(&type_size) || !in_archive->Load(&id) ||
-      !LoadInt32(&offset, in_archive) || !LoadInt32(&base_delta, in_archive)) {
+  bool id_loaded = false;
+  if (in_archive->Load(&type_size)) {
+    if (has_attributes(DELTA_ENCODING)) {
+      int32 id_delta = 0;
+      id_loaded = LoadInt32(&id_delta, in_archive);
+      id = *previous_id + id_delta;
+      *previous_id = id;
+    } else {
+      id_loaded = in_archive->Load(&id);
+    }
+  }
+
+  if (!id_loaded || !LoadInt32(&offset, in_archive) ||
+      !LoadInt32(&base_delta, in_archive)) {
     LOG(ERROR) << "Unable to load reference properties.";
     return false;
   }
@@ -747,7 +997,7 @@ bool BlockGraphSerializer::LoadReference(BlockGraph* block_graph,
     return false;
   }
 
-  BlockGraph::Block* referenced = block_graph->GetBlockById(id);
+  BlockGraph::Block* referenced = GetReferencedBlock(block_graph, id);
   if (referenced == NULL) {
     LOG(ERROR) << "Unable to find referenced block with id " << id << ".";
     return false;
@@ -759,6 +1009,48 @@ bool BlockGraphSerializer::LoadReference(BlockGraph* block_graph,
   return true;
 }
 
+BlockGraph::Block* BlockGraphSerializer::GetReferencedBlock(
+    BlockGraph* block_graph, BlockGraph::BlockId id) const {
+  DCHECK(block_graph != NULL);
+  return block_graph->GetBlockById(id);
+}
+
+bool BlockGraphSerializer::SaveCount(size_t count,
+                                     OutArchive* out_archive) const {
+  DCHECK(out_archive != NULL);
+
+  if (has_attributes(DELTA_ENCODING))
+    return SaveUint32(count, out_archive);
+
+  if (!out_archive->Save(count)) {
+    LOG(ERROR) << "Unable to write count.";
+    return false;
+  }
+
+  return true;
+}
+
+bool BlockGraphSerializer::LoadCount(size_t* count,
+                                     InArchive* in_archive) const {
+  DCHECK(count != NULL);
+  DCHECK(in_archive != NULL);
+
+  if (has_attributes(DELTA_ENCODING)) {
+    uint32 value = 0;
+    if (!LoadUint32(&value, in_archive))
+      return false;
+    *count = value;
+    return true;
+  }
+
+  if (!in_archive->Load(count)) {
+    LOG(ERROR) << "Unable to read count.";
+    return false;
+  }
+
+  return true;
+}
+
 // Saves an unsigned 32 bit value. This uses a variable length encoding where
 // the first three bits are reserved to indicate the number of bytes required to
 // store the value.
@@ -17,6 +17,8 @@
 #ifndef SYZYGY_BLOCK_GRAPH_BLOCK_GRAPH_SERIALIZER_H_
 #define SYZYGY_BLOCK_GRAPH_BLOCK_GRAPH_SERIALIZER_H_
 
+#include <vector>
+
 #include "base/basictypes.h"
 #include "base/callback.h"
 #include "syzygy/block_graph/block_graph.h"
@@ -71,8 +73,20 @@ class BlockGraphSerializer {
     // block disassembly impossible.
     OMIT_LABELS = (1 << 1),
 
+    // If specified then block IDs, label and reference offsets, and the blocks
+    // targeted by references are saved as variable-length differences from
+    // the preceding value rather than as raw values. This makes the
+    // serialization smaller and much more compressible, at no cost in load
+    // time.
+    DELTA_ENCODING = (1 << 2),
+
+    // If specified then the blocks and their references are saved as separate
+    // records, preceded by an index of their sizes. This allows the blocks to
+    // be loaded on demand by a LazyBlockGraphLoader.
+    BLOCK_INDEX = (1 << 3),
+
     // This needs to be last, and the next unused attributes enum bit.
-    ATTRIBUTES_MAX = (1 << 2),
+    ATTRIBUTES_MAX = (1 << 4),
   };
 
   // Defines the callback used to save data for a block. The callback is given
@@ -134,6 +148,8 @@ class BlockGraphSerializer {
   BlockGraphSerializer()
       : data_mode_(DEFAULT_DATA_MODE), attributes_(DEFAULT_ATTRIBUTES) { }
 
+  virtual ~BlockGraphSerializer() { }
+
   // @name For setting and accessing the data mode.
   // @{
   DataMode data_mode() const { return data_mode_; }
@@ -203,6 +219,27 @@ class BlockGraphSerializer {
   bool Load(BlockGraph* block_graph, core::InArchive* in_archive);
 
  protected:
+  // An entry of the block index saved with BLOCK_INDEX.
+  struct BlockIndexEntry {
+    BlockIndexEntry() : id(0), block_size(0), references_size(0) { }
+
+    // The ID of the block.
+    BlockGraph::BlockId id;
+    // The size of the record holding the properties, labels and data of the
+    // block, in bytes.
+    uint32 block_size;
+    // The size of the record holding the references of the block, in bytes.
+    uint32 references_size;
+  };
+  typedef std::vector<BlockIndexEntry> BlockIndex;
+
+  // Loads the version, the data mode and the attributes of a serialized
+  // block-graph, and updates the data mode and the attributes of this
+  // serializer.
+  // @param in_archive the archive to be read from.
+  // @returns true on success, false otherwise.
+  bool LoadHeader(InArchive* in_archive);
+
   // @{
   // The block-graph is serialized by breaking it down into its constituent
   // pieces, and saving each of these using the following functions.
@@ -214,6 +251,18 @@ class BlockGraphSerializer {
   bool SaveBlocks(const BlockGraph& block_graph, OutArchive* out_archive) const;
   bool LoadBlocks(BlockGraph* block_graph, InArchive* in_archive) const;
 
+  // With BLOCK_INDEX, the blocks and their references are saved as an index
+  // followed by the records of the blocks, then by those of their references.
+  bool SaveIndexedBlocks(const BlockGraph& block_graph,
+                         OutArchive* out_archive) const;
+  bool LoadBlockIndex(BlockIndex* index, InArchive* in_archive) const;
+
+  // Creates a block with the given ID and loads its properties, labels and
+  // data, but not its references.
+  bool LoadBlock(BlockGraph* block_graph,
+                 BlockGraph::BlockId id,
+                 InArchive* in_archive) const;
+
   bool SaveBlockGraphReferences(const BlockGraph& block_graph,
                                 OutArchive* out_archive) const;
   bool LoadBlockGraphReferences(BlockGraph* block_graph,
@@ -238,13 +287,34 @@ class BlockGraphSerializer {
                            BlockGraph::Block* block,
                            InArchive* in_archive) const;
 
+  // @p previous_id holds the ID of the block targeted by the preceding
+  // reference, and is only used and updated with DELTA_ENCODING.
   bool SaveReference(const BlockGraph::Reference& ref,
+                     BlockGraph::BlockId* previous_id,
                      OutArchive* out_archive) const;
   bool LoadReference(BlockGraph* block_graph,
                      BlockGraph::Reference* ref,
+                     BlockGraph::BlockId* previous_id,
                      InArchive* in_archive) const;
   // @}
 
+  // Looks up the block targeted by a reference being loaded.
+  // @param block_graph the block-graph being loaded.
+  // @param id the ID of the referenced block.
+  // @returns the referenced block, or NULL if there is none.
+  // @note This is virtual so that the referenced blocks can be loaded on
+  //     demand.
+  virtual BlockGraph::Block* GetReferencedBlock(BlockGraph* block_graph,
+                                                BlockGraph::BlockId id) const;
+
+  // @{
+  // Utility functions for saving and loading a count of items. With
+  // DELTA_ENCODING this uses the variable-length encoding, otherwise it is
+  // saved as a raw size_t.
+  bool SaveCount(size_t count, OutArchive* out_archive) const;
+  bool LoadCount(size_t* count, InArchive* in_archive) const;
+  // @}
+
   // @{
   // Utility functions for loading and saving integer values with a simple
   // variable-length encoding.
@@ -521,6 +521,46 @@ TEST_F(BlockGraphSerializerTest, RoundTripAllData) {
       eNoBlockDataCallbacks, 0));
 }
 
+TEST_F(BlockGraphSerializerTest, RoundTripOwnedDataDeltaEncoding) {
+  ASSERT_NO_FATAL_FAILURE(TestRoundTrip(
+      BlockGraphSerializer::OUTPUT_OWNED_DATA,
+      BlockGraphSerializer::DELTA_ENCODING,
+      eInitBlockDataCallbacks1, 2));
+}
+
+TEST_F(BlockGraphSerializerTest, RoundTripAllDataDeltaEncoding) {
+  ASSERT_NO_FATAL_FAILURE(TestRoundTrip(
+      BlockGraphSerializer::OUTPUT_ALL_DATA,
+      BlockGraphSerializer::DELTA_ENCODING | BlockGraphSerializer::OMIT_STRINGS,
+      eNoBlockDataCallbacks, 0));
+}
+
+TEST_F(BlockGraphSerializerTest, RoundTripNoDataBlockIndex) {
+  ASSERT_NO_FATAL_FAILURE(TestRoundTrip(
+      BlockGraphSerializer::OUTPUT_NO_DATA,
+      BlockGraphSerializer::BLOCK_INDEX,
+      eInitBlockDataCallbacks2, 4));
+}
+
+TEST_F(BlockGraphSerializerTest, RoundTripAllDataBlockIndexDeltaEncoding) {
+  ASSERT_NO_FATAL_FAILURE(TestRoundTrip(
+      BlockGraphSerializer::OUTPUT_ALL_DATA,
+      BlockGraphSerializer::BLOCK_INDEX | BlockGraphSerializer::DELTA_ENCODING,
+      eNoBlockDataCallbacks, 0));
+}
+
+TEST_F(BlockGraphSerializerTest, DeltaEncodingIsSmaller) {
+  InitBlockGraph();
+  InitOutArchive();
+  ASSERT_TRUE(s_.Save(bg_, oa_.get()));
+  size_t raw_size = v_.size();
+
+  InitOutArchive();
+  s_.set_attributes(BlockGraphSerializer::DELTA_ENCODING);
+  ASSERT_TRUE(s_.Save(bg_, oa_.get()));
+  EXPECT_GT(raw_size, v_.size());
+}
+
 // TODO(chrisha): Do a heck of a lot more testing of protected member functions.
 
 }  // namespace block_graph
@@ -1062,6 +1062,57 @@ TEST(BlockGraphTest, References) {
   EXPECT_THAT(b2->referrers(), BlockGraph::Block::ReferrerSet());
 }
 
+TEST(BlockGraphTest, SetReferences) {
+  BlockGraph image;
+
+  BlockGraph::Block* b1 = image.AddBlock(BlockGraph::CODE_BLOCK, 0x20, "b1");
+  BlockGraph::Block* b2 = image.AddBlock(BlockGraph::CODE_BLOCK, 0x20, "b2");
+  BlockGraph::Block* b3 = image.AddBlock(BlockGraph::DATA_BLOCK, 0x20, "b3");
+  ASSERT_TRUE(b1 != NULL);
+  ASSERT_TRUE(b2 != NULL);
+  ASSERT_TRUE(b3 != NULL);
+
+  BlockGraph::Reference r_pc(BlockGraph::PC_RELATIVE_REF, 4, b2, 0, 0);
+  BlockGraph::Reference r_abs2(BlockGraph::ABSOLUTE_REF, 4, b2, 8, 8);
+  BlockGraph::Reference r_abs3(BlockGraph::ABSOLUTE_REF, 4, b3, 4, 4);
+  BlockGraph::Reference r_self(BlockGraph::ABSOLUTE_REF, 4, b3, 0, 0);
+
+  // An existing reference that will be overridden by the batch.
+  ASSERT_TRUE(b1->SetReference(8, r_abs2));
+
+  BlockGraph::PendingReferences references;
+  references.push_back(std::make_pair(std::make_pair(b3, 0), r_self));
+  references.push_back(std::make_pair(std::make_pair(b1, 8), r_abs3));
+  references.push_back(std::make_pair(std::make_pair(b1, 0), r_pc));
+  references.push_back(std::make_pair(std::make_pair(b3, 4), r_abs2));
+  // This overrides the reference set just above.
+  references.push_back(std::make_pair(std::make_pair(b3, 4), r_pc));
+  image.SetReferences(&references);
+
+  BlockGraph::Block::ReferenceMap expected_refs;
+  expected_refs.insert(std::make_pair(0, r_pc));
+  expected_refs.insert(std::make_pair(8, r_abs3));
+  EXPECT_THAT(b1->references(), testing::ContainerEq(expected_refs));
+
+  expected_refs.clear();
+  expected_refs.insert(std::make_pair(0, r_self));
+  expected_refs.insert(std::make_pair(4, r_pc));
+  EXPECT_THAT(b3->references(), testing::ContainerEq(expected_refs));
+  EXPECT_TRUE(b2->references().empty());
+
+  BlockGraph::Block::ReferrerSet expected_referrers;
+  EXPECT_THAT(b1->referrers(), testing::ContainerEq(expected_referrers));
+
+  expected_referrers.insert(std::make_pair(b1, 0));
+  expected_referrers.insert(std::make_pair(b3, 4));
+  EXPECT_THAT(b2->referrers(), testing::ContainerEq(expected_referrers));
+
+  expected_referrers.clear();
+  expected_referrers.insert(std::make_pair(b1, 8));
+  expected_referrers.insert(std::make_pair(b3, 0));
+  EXPECT_THAT(b3->referrers(), testing::ContainerEq(expected_referrers));
+}
+
 TEST(BlockGraphTest, Labels) {
   BlockGraph image;
 
@@ -1131,6 +1182,170 @@ TEST(BlockGraphTest, StringTable) {
   EXPECT_NE(&interned_str3, &interned_str4);
 }
 
+TEST(BlockGraphTest, DataSlabs) {
+  BlockGraph block_graph;
+  EXPECT_FALSE(block_graph.use_data_slabs());
+  EXPECT_TRUE(block_graph.set_use_data_slabs(true));
+  EXPECT_TRUE(block_graph.use_data_slabs());
+
+  BlockGraph::Block* block1 =
+      block_graph.AddBlock(BlockGraph::CODE_BLOCK, 30, "block1");
+  BlockGraph::Block* block2 =
+      block_graph.AddBlock(BlockGraph::DATA_BLOCK, 30, "block2");
+  ASSERT_TRUE(block1 != NULL);
+  ASSERT_TRUE(block2 != NULL);
+
+  // The allocation mode can't change once there are blocks.
+  EXPECT_FALSE(block_graph.set_use_data_slabs(false));
+  EXPECT_TRUE(block_graph.use_data_slabs());
+
+  // Data is allocated, copied and resized as usual.
+  uint8* data1 = block1->AllocateData(20);
+  ASSERT_TRUE(data1 != NULL);
+  EXPECT_EQ(0, data1[19]);
+  ::memset(data1, 0xAB, 20);
+  const uint8* data2 = block2->CopyData(20, data1);
+  ASSERT_TRUE(data2 != NULL);
+  EXPECT_NE(data1, data2);
+  EXPECT_EQ(0, ::memcmp(data1, data2, 20));
+
+  ASSERT_TRUE(block1->ResizeData(30) != NULL);
+  EXPECT_EQ(0xAB, block1->data()[19]);
+  EXPECT_EQ(0, block1->data()[29]);
+
+  // The buffer freed by the resize is recycled.
+  BlockGraph::MemoryStatistics stats;
+  block_graph.GetMemoryStatistics(&stats);
+  EXPECT_LT(0u, stats.data_slab_size);
+  EXPECT_LT(0u, stats.free_data_size);
+  size_t free_data_size = stats.free_data_size;
+
+  BlockGraph::Block* block3 =
+      block_graph.AddBlock(BlockGraph::DATA_BLOCK, 30, "block3");
+  ASSERT_TRUE(block3 != NULL);
+  EXPECT_TRUE(block3->AllocateData(20) != NULL);
+  block_graph.GetMemoryStatistics(&stats);
+  EXPECT_GT(free_data_size, stats.free_data_size);
+
+  // Removing a block returns its data.
+  EXPECT_TRUE(block_graph.RemoveBlock(block3));
+  block_graph.GetMemoryStatistics(&stats);
+  EXPECT_EQ(free_data_size, stats.free_data_size);
+}
+
+TEST(BlockGraphTest, GetMemoryStatistics) {
+  static const uint8 kData[16] = {};
+
+  BlockGraph block_graph;
+  BlockGraph::Section* section = block_graph.AddSection(".text", 0);
+  ASSERT_TRUE(section != NULL);
+
+  BlockGraph::Block* code =
+      block_graph.AddBlock(BlockGraph::CODE_BLOCK, 32, "code");
+  BlockGraph::Block* data1 =
+      block_graph.AddBlock(BlockGraph::DATA_BLOCK, 32, "data1");
+  BlockGraph::Block* data2 =
+      block_graph.AddBlock(BlockGraph::DATA_BLOCK, 32, "data2");
+  ASSERT_TRUE(code != NULL);
+  ASSERT_TRUE(data1 != NULL);
+  ASSERT_TRUE(data2 != NULL);
+  code->set_section(section->id());
+  ASSERT_TRUE(code->AllocateData(32) != NULL);
+  data1->SetData(kData, sizeof(kData));
+  ASSERT_TRUE(code->SetReference(0, BlockGraph::Reference(
+      BlockGraph::ABSOLUTE_REF, 4, data1, 0, 0)));
+
+  BlockGraph::MemoryStatistics stats;
+  block_graph.GetMemoryStatistics(&stats);
+
+  EXPECT_EQ(3u, stats.total.block_count);
+  EXPECT_EQ(32u, stats.total.owned_data_size);
+  EXPECT_EQ(sizeof(kData), stats.total.unowned_data_size);
+  EXPECT_LT(3 * sizeof(BlockGraph::Block), stats.total.block_size);
+
+  EXPECT_EQ(1u, stats.by_type[BlockGraph::CODE_BLOCK].block_count);
+  EXPECT_EQ(32u, stats.by_type[BlockGraph::CODE_BLOCK].owned_data_size);
+  EXPECT_EQ(2u, stats.by_type[BlockGraph::DATA_BLOCK].block_count);
+  EXPECT_EQ(sizeof(kData),
+            stats.by_type[BlockGraph::DATA_BLOCK].unowned_data_size);
+
+  ASSERT_EQ(2u, stats.by_section.size());
+  EXPECT_EQ(1u, stats.by_section[section->id()].block_count);
+  EXPECT_EQ(2u, stats.by_section[BlockGraph::kInvalidSectionId].block_count);
+
+  // Slabs aren't in use.
+  EXPECT_EQ(0u, stats.data_slab_size);
+  EXPECT_EQ(0u, stats.free_data_size);
+}
+
+TEST(BlockGraphTest, CreateSnapshot) {
+  BlockGraph block_graph;
+  BlockGraph::Section* section = block_graph.AddSection(".text", 0);
+  ASSERT_TRUE(section != NULL);
+
+  BlockGraph::Block* code =
+      block_graph.AddBlock(BlockGraph::CODE_BLOCK, 32, "code");
+  BlockGraph::Block* data =
+      block_graph.AddBlock(BlockGraph::DATA_BLOCK, 32, "data");
+  ASSERT_TRUE(code != NULL);
+  ASSERT_TRUE(data != NULL);
+  code->set_section(section->id());
+  code->set_alignment(16);
+  code->set_compiland_name("compiland");
+  ASSERT_TRUE(code->AllocateData(32) != NULL);
+  ASSERT_TRUE(code->SetLabel(0, "code", BlockGraph::CODE_LABEL));
+  ASSERT_TRUE(code->SetReference(4, BlockGraph::Reference(
+      BlockGraph::ABSOLUTE_REF, 4, data, 8, 8)));
+  ASSERT_TRUE(data->AllocateData(16) != NULL);
+
+  BlockGraph snapshot;
+  ASSERT_TRUE(block_graph.CreateSnapshot(&snapshot));
+
+  // Only an empty block-graph can receive a snapshot.
+  EXPECT_FALSE(block_graph.CreateSnapshot(&snapshot));
+
+  EXPECT_EQ(block_graph.sections(), snapshot.sections());
+  ASSERT_EQ(block_graph.blocks().size(), snapshot.blocks().size());
+
+  BlockGraph::Block* code_copy = snapshot.GetBlockById(code->id());
+  BlockGraph::Block* data_copy = snapshot.GetBlockById(data->id());
+  ASSERT_TRUE(code_copy != NULL);
+  ASSERT_TRUE(data_copy != NULL);
+  EXPECT_EQ(BlockGraph::CODE_BLOCK, code_copy->type());
+  EXPECT_EQ(code->size(), code_copy->size());
+  EXPECT_EQ(code->name(), code_copy->name());
+  EXPECT_EQ(code->compiland_name(), code_copy->compiland_name());
+  EXPECT_EQ(code->alignment(), code_copy->alignment());
+  EXPECT_EQ(code->section(), code_copy->section());
+  EXPECT_EQ(code->labels(), code_copy->labels());
+
+  // The references refer to the blocks of the snapshot.
+  BlockGraph::Reference ref;
+  ASSERT_TRUE(code_copy->GetReference(4, &ref));
+  EXPECT_EQ(data_copy, ref.referenced());
+  EXPECT_EQ(8, ref.offset());
+  EXPECT_EQ(1u, data_copy->referrers().size());
+  EXPECT_EQ(1u, data_copy->referrers().count(
+      BlockGraph::Block::Referrer(code_copy, 4)));
+  EXPECT_EQ(1u, data->referrers().count(BlockGraph::Block::Referrer(code, 4)));
+
+  // The data is shared until it gets modified.
+  EXPECT_EQ(code->data(), code_copy->data());
+  EXPECT_FALSE(code_copy->owns_data());
+  uint8* mutable_data = code_copy->GetMutableData();
+  ASSERT_TRUE(mutable_data != NULL);
+  EXPECT_NE(code->data(), code_copy->data());
+  mutable_data[0] = 0xCC;
+  EXPECT_EQ(0, code->data()[0]);
+  EXPECT_EQ(data->data(), data_copy->data());
+
+  // The snapshot allocates new block ids past the original ones.
+  BlockGraph::Block* added =
+      snapshot.AddBlock(BlockGraph::DATA_BLOCK, 4, "added");
+  ASSERT_TRUE(added != NULL);
+  EXPECT_TRUE(block_graph.GetBlockById(added->id()) == NULL);
+}
+
 namespace {
 
 class BlockGraphSerializationTest : public testing::Test {
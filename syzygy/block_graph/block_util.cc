@@ -26,9 +26,14 @@ bool CodeBlockAttributesAreBasicBlockSafe(
   DCHECK(block != NULL);
   DCHECK_EQ(BlockGraph::CODE_BLOCK, block->type());
 
+  return CodeBlockAttributesAreBasicBlockSafe(block->attributes());
+}
+
+bool CodeBlockAttributesAreBasicBlockSafe(
+    BlockGraph::BlockAttributes attributes) {
   // If the block was built by our toolchain it's inherently safe. This
   // attribute is used to whitelist a block.
-  if (block->attributes() & BlockGraph::BUILT_BY_SYZYGY)
+  if (attributes & BlockGraph::BUILT_BY_SYZYGY)
     return true;
 
   // Any of the following attributes make it unsafe to basic-block
@@ -41,7 +46,7 @@ bool CodeBlockAttributesAreBasicBlockSafe(
       BlockGraph::ERRORED_DISASSEMBLY |
       BlockGraph::HAS_EXCEPTION_HANDLING |
       BlockGraph::DISASSEMBLED_PAST_END;
-  if ((block->attributes() & kInvalidAttributes) != 0)
+  if ((attributes & kInvalidAttributes) != 0)
     return false;
 
   return true;
@@ -31,6 +31,15 @@ namespace block_graph {
 // @pre block has type CODE_BLOCK.
 bool CodeBlockAttributesAreBasicBlockSafe(const BlockGraph::Block* block);
 
+// Determines whether the given code block @p attributes preclude basic-block
+// decomposition. This is useful when the attributes of a block are being
+// accumulated before being applied to it.
+// @param attributes the code block attributes to be inspected.
+// @returns true if the attributes are safe for decomposition to basic-blocks,
+//     false otherwise.
+bool CodeBlockAttributesAreBasicBlockSafe(
+    BlockGraph::BlockAttributes attributes);
+
 // Determines whether @p bb's instructions and successors comprise a contiguous
 // source range, and return it if so.
 // @param bb the basic block to inspect.
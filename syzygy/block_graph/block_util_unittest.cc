@@ -34,6 +34,7 @@ class BlockUtilTest: public testing::Test {
     BlockGraph::Block* code = image_.AddBlock(BlockGraph::CODE_BLOCK, 40, "c");
     code->set_attributes(attributes);
     ASSERT_EQ(expected, CodeBlockAttributesAreBasicBlockSafe(code));
+    ASSERT_EQ(expected, CodeBlockAttributesAreBasicBlockSafe(attributes));
   }
 
   BlockGraph::Size AddInstructions(bool add_source_ranges) {
@@ -0,0 +1,69 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/block_graph/instruction_cache.h"
+
+namespace block_graph {
+
+InstructionCache::InstructionCache() : hits_(0), misses_(0) {
+}
+
+const InstructionCache::Instructions* InstructionCache::Lookup(
+    const BlockGraph::Block* block, Offset code_begin, Offset code_end) {
+  DCHECK(block != NULL);
+
+  EntryMap::iterator it = entries_.find(block->id());
+  if (it == entries_.end()) {
+    ++misses_;
+    return NULL;
+  }
+
+  const Entry& entry = it->second;
+  if (entry.data_version != block->data_version() ||
+      entry.data != block->data() ||
+      entry.data_size != block->data_size() ||
+      entry.code_begin != code_begin ||
+      entry.code_end != code_end) {
+    // The block has changed, the entry is of no further use.
+    entries_.erase(it);
+    ++misses_;
+    return NULL;
+  }
+
+  ++hits_;
+  return &entry.instructions;
+}
+
+void InstructionCache::Insert(const BlockGraph::Block* block,
+                              Offset code_begin,
+                              Offset code_end,
+                              Instructions* instructions) {
+  DCHECK(block != NULL);
+  DCHECK(instructions != NULL);
+
+  Entry& entry = entries_[block->id()];
+  entry.data_version = block->data_version();
+  entry.data = block->data();
+  entry.data_size = block->data_size();
+  entry.code_begin = code_begin;
+  entry.code_end = code_end;
+  entry.instructions.swap(*instructions);
+  instructions->clear();
+}
+
+void InstructionCache::Clear() {
+  entries_.clear();
+}
+
+}  // namespace block_graph
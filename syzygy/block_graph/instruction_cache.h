@@ -0,0 +1,104 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares InstructionCache, which keeps the decoded instructions of code
+// blocks around so that decomposing a block into basic blocks again doesn't
+// have to run the decoder a second time.
+
+#ifndef SYZYGY_BLOCK_GRAPH_INSTRUCTION_CACHE_H_
+#define SYZYGY_BLOCK_GRAPH_INSTRUCTION_CACHE_H_
+
+#include <map>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "syzygy/block_graph/block_graph.h"
+
+#include "distorm.h"  // NOLINT
+
+namespace block_graph {
+
+// Caches the decoded instructions of the code range of blocks, keyed by block
+// ID. An entry is only used while the data version of its block, the location
+// and size of its data and its code range are unchanged, so modifying a block
+// implicitly invalidates its entry. A cache must only be used with the blocks
+// of a single block-graph, and isn't thread-safe.
+class InstructionCache {
+ public:
+  typedef BlockGraph::BlockId BlockId;
+  typedef BlockGraph::Offset Offset;
+  typedef std::vector<_DInst> Instructions;
+
+  InstructionCache();
+
+  // Looks up the decoded instructions of a block.
+  // @param block the block whose instructions are looked up.
+  // @param code_begin the offset at which the code of @p block begins.
+  // @param code_end the offset at which the code of @p block ends.
+  // @returns the instructions decoded in the range [@p code_begin,
+  //     @p code_end) of @p block, in order, or NULL if they aren't cached or
+  //     if the block has changed since they were.
+  const Instructions* Lookup(const BlockGraph::Block* block,
+                             Offset code_begin,
+                             Offset code_end);
+
+  // Caches the decoded instructions of a block, replacing any previous entry.
+  // @param block the block whose instructions are cached.
+  // @param code_begin the offset at which the code of @p block begins.
+  // @param code_end the offset at which the code of @p block ends.
+  // @param instructions the instructions decoded in the range
+  //     [@p code_begin, @p code_end) of @p block, in order. This is swapped
+  //     into the cache and is empty on return.
+  void Insert(const BlockGraph::Block* block,
+              Offset code_begin,
+              Offset code_end,
+              Instructions* instructions);
+
+  // Removes all of the entries.
+  void Clear();
+
+  // @returns the number of cached blocks.
+  size_t size() const { return entries_.size(); }
+
+  // @returns the number of successful lookups.
+  size_t hits() const { return hits_; }
+
+  // @returns the number of failed lookups.
+  size_t misses() const { return misses_; }
+
+ private:
+  // The decoded instructions of a block, along with what they depend on.
+  struct Entry {
+    uint32 data_version;
+    const uint8* data;
+    size_t data_size;
+    Offset code_begin;
+    Offset code_end;
+    Instructions instructions;
+  };
+  typedef std::map<BlockId, Entry> EntryMap;
+
+  // The cached blocks.
+  EntryMap entries_;
+
+  // Lookup statistics.
+  size_t hits_;
+  size_t misses_;
+
+  DISALLOW_COPY_AND_ASSIGN(InstructionCache);
+};
+
+}  // namespace block_graph
+
+#endif  // SYZYGY_BLOCK_GRAPH_INSTRUCTION_CACHE_H_
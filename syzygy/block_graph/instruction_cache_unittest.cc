@@ -0,0 +1,100 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/block_graph/instruction_cache.h"
+
+#include "gtest/gtest.h"
+
+namespace block_graph {
+
+namespace {
+
+const uint8 kData[] = { 0x90, 0x90, 0xC3 };
+
+// Builds a list of instructions with the given sizes.
+void MakeInstructions(size_t count, InstructionCache::Instructions* insts) {
+  insts->resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    ::memset(&insts->at(i), 0, sizeof(insts->at(i)));
+    insts->at(i).size = 1;
+  }
+}
+
+}  // namespace
+
+TEST(InstructionCacheTest, LookupAndInsert) {
+  BlockGraph block_graph;
+  BlockGraph::Block* block =
+      block_graph.AddBlock(BlockGraph::CODE_BLOCK, sizeof(kData), "code");
+  ASSERT_TRUE(block != NULL);
+  block->SetData(kData, sizeof(kData));
+
+  InstructionCache cache;
+  EXPECT_EQ(0u, cache.size());
+  EXPECT_TRUE(cache.Lookup(block, 0, sizeof(kData)) == NULL);
+  EXPECT_EQ(1u, cache.misses());
+
+  InstructionCache::Instructions insts;
+  MakeInstructions(3, &insts);
+  cache.Insert(block, 0, sizeof(kData), &insts);
+  EXPECT_TRUE(insts.empty());
+  EXPECT_EQ(1u, cache.size());
+
+  const InstructionCache::Instructions* cached =
+      cache.Lookup(block, 0, sizeof(kData));
+  ASSERT_TRUE(cached != NULL);
+  EXPECT_EQ(3u, cached->size());
+  EXPECT_EQ(1u, cache.hits());
+
+  // A different code range doesn't match, and drops the entry.
+  EXPECT_TRUE(cache.Lookup(block, 0, 2) == NULL);
+  EXPECT_EQ(2u, cache.misses());
+  EXPECT_EQ(0u, cache.size());
+
+  MakeInstructions(3, &insts);
+  cache.Insert(block, 0, sizeof(kData), &insts);
+  EXPECT_EQ(1u, cache.size());
+  cache.Clear();
+  EXPECT_EQ(0u, cache.size());
+}
+
+TEST(InstructionCacheTest, ModifyingDataInvalidates) {
+  BlockGraph block_graph;
+  BlockGraph::Block* block =
+      block_graph.AddBlock(BlockGraph::CODE_BLOCK, sizeof(kData), "code");
+  ASSERT_TRUE(block != NULL);
+  block->SetData(kData, sizeof(kData));
+
+  InstructionCache cache;
+  InstructionCache::Instructions insts;
+  MakeInstructions(3, &insts);
+  cache.Insert(block, 0, sizeof(kData), &insts);
+  EXPECT_TRUE(cache.Lookup(block, 0, sizeof(kData)) != NULL);
+
+  // Getting mutable data changes the data version.
+  uint32 data_version = block->data_version();
+  block->GetMutableData();
+  EXPECT_NE(data_version, block->data_version());
+  EXPECT_TRUE(cache.Lookup(block, 0, sizeof(kData)) == NULL);
+
+  MakeInstructions(3, &insts);
+  cache.Insert(block, 0, sizeof(kData), &insts);
+  EXPECT_TRUE(cache.Lookup(block, 0, sizeof(kData)) != NULL);
+
+  // So does resizing it.
+  block->ResizeData(2);
+  EXPECT_TRUE(cache.Lookup(block, 0, sizeof(kData)) == NULL);
+}
+
+}  // namespace block_graph
@@ -14,8 +14,84 @@
 
 #include "syzygy/block_graph/iterate.h"
 
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include "base/memory/scoped_vector.h"
+#include "base/threading/simple_thread.h"
+#include "syzygy/block_graph/basic_block_decomposer.h"
+
 namespace block_graph {
 
+namespace {
+
+typedef std::set<const BlockGraph::Block*> ConstBlockSet;
+
+// The maximum number of blocks in a window of a concurrent iteration. This
+// bounds the number of decompositions that are alive at any given time.
+const size_t kMaxWindowSize = 1024;
+
+// A block in a window of a concurrent iteration, along with its
+// decomposition, if any.
+class WindowEntry : public base::DelegateSimpleThread::Delegate {
+ public:
+  WindowEntry(BlockGraph::Block* block, bool decompose)
+      : block_(block), decompose_(decompose), decomposed_(false) {
+    DCHECK(block != NULL);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  // Decomposes the block. This may be called on a worker thread, while the
+  // block graph is only ever read.
+  virtual void Run() OVERRIDE {
+    DCHECK(decompose_);
+    BasicBlockDecomposer decomposer(block_, &subgraph_);
+    decomposed_ = decomposer.Decompose();
+  }
+  // @}
+
+  // @name Accessors.
+  // @{
+  BlockGraph::Block* block() const { return block_; }
+  bool decompose() const { return decompose_; }
+  bool decomposed() const { return decomposed_; }
+  BasicBlockSubGraph* subgraph() { return &subgraph_; }
+  // @}
+
+ private:
+  BlockGraph::Block* block_;
+  bool decompose_;
+  bool decomposed_;
+  BasicBlockSubGraph subgraph_;
+
+  DISALLOW_COPY_AND_ASSIGN(WindowEntry);
+};
+
+// @returns true iff @p block neither references nor is referenced by any of
+//     @p blocks.
+bool IsIndependentOf(const BlockGraph::Block* block,
+                     const ConstBlockSet& blocks) {
+  BlockGraph::Block::ReferenceMap::const_iterator ref_it =
+      block->references().begin();
+  for (; ref_it != block->references().end(); ++ref_it) {
+    if (blocks.count(ref_it->second.referenced()) != 0)
+      return false;
+  }
+
+  BlockGraph::Block::ReferrerSet::const_iterator referrer_it =
+      block->referrers().begin();
+  for (; referrer_it != block->referrers().end(); ++referrer_it) {
+    if (blocks.count(referrer_it->first) != 0)
+      return false;
+  }
+
+  return true;
+}
+
+}  // namespace
+
 bool IterateBlockGraph(const IterationCallback& callback,
                        BlockGraph* block_graph) {
   DCHECK(block_graph != NULL);
@@ -54,4 +130,97 @@ bool IterateBlockGraph(const IterationCallback& callback,
   return true;
 }
 
+bool IterateBlockGraphConcurrently(
+    const DecompositionPredicate& predicate,
+    const IterationCallback& callback,
+    const DecomposedIterationCallback& decomposed_callback,
+    size_t num_threads,
+    BlockGraph* block_graph) {
+  DCHECK_LT(0u, num_threads);
+  DCHECK(block_graph != NULL);
+
+  if (block_graph->blocks().size() == 0)
+    return true;
+
+  // Get the ID of the last existing block in iterator order.
+  BlockGraph::BlockMap::iterator last_block_it =
+      block_graph->blocks_mutable().end();
+  --last_block_it;
+  BlockGraph::BlockId last_block_id = last_block_it->second.id();
+
+  BlockGraph::BlockMap::iterator block_it =
+      block_graph->blocks_mutable().begin();
+  bool done = false;
+  while (!done) {
+    // Gather a window of consecutive blocks, ending it early at the first
+    // block to decompose that's related to one already in the window. The
+    // callbacks may only delete the block they're handed, and new blocks are
+    // added past the pre-existing ones, so block_it remains valid throughout.
+    ScopedVector<WindowEntry> window;
+    std::vector<WindowEntry*> decompositions;
+    ConstBlockSet decomposed_blocks;
+    while (!done && window.size() < kMaxWindowSize) {
+      BlockGraph::Block* block = &block_it->second;
+      bool decompose = predicate.Run(block);
+      if (decompose) {
+        if (!IsIndependentOf(block, decomposed_blocks))
+          break;
+        decomposed_blocks.insert(block);
+      }
+
+      window.push_back(new WindowEntry(block, decompose));
+      if (decompose)
+        decompositions.push_back(window.back());
+
+      done = block->id() == last_block_id;
+      ++block_it;
+    }
+    DCHECK(!window.empty());
+
+    // Decompose the window's blocks. Nothing modifies the block graph until
+    // all of the decompositions are complete.
+    size_t num_workers = std::min(num_threads, decompositions.size());
+    if (num_workers > 1) {
+      base::DelegateSimpleThreadPool pool("IterateBlockGraph",
+                                          static_cast<int>(num_workers));
+      pool.Start();
+      for (size_t i = 0; i < decompositions.size(); ++i)
+        pool.AddWork(decompositions[i]);
+      pool.JoinAll();
+    } else {
+      for (size_t i = 0; i < decompositions.size(); ++i)
+        decompositions[i]->Run();
+    }
+
+    // Hand the window's blocks to the callbacks, in order. As no two
+    // decomposed blocks in the window are related, merging one subgraph
+    // leaves the others valid.
+    for (size_t i = 0; i < window.size(); ++i) {
+      WindowEntry* entry = window[i];
+      BlockGraph::Block* block = entry->block();
+
+      bool result = false;
+      if (!entry->decompose()) {
+        result = callback.Run(block_graph, block);
+      } else {
+        if (!entry->decomposed()) {
+          LOG(ERROR) << "Failed to basic-block decompose block \""
+                     << block->name() << "\".";
+          return false;
+        }
+        result = decomposed_callback.Run(block_graph, block,
+                                         entry->subgraph());
+      }
+
+      if (!result) {
+        LOG(ERROR) << "IterateBlocks callback failed for block "
+                   << "\"" << block->name() << "\".";
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
 }  // namespace block_graph
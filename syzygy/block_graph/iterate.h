@@ -19,6 +19,7 @@
 #define SYZYGY_BLOCK_GRAPH_ITERATE_H_
 
 #include "base/callback.h"
+#include "syzygy/block_graph/basic_block_subgraph.h"
 #include "syzygy/block_graph/block_graph.h"
 
 namespace block_graph {
@@ -47,6 +48,48 @@ typedef base::Callback<bool(BlockGraph* block_graph,
 bool IterateBlockGraph(const IterationCallback& callback,
                        BlockGraph* block_graph);
 
+// The type of callback used by IterateBlockGraphConcurrently to select the
+// blocks that are basic-block decomposed ahead of time.
+typedef base::Callback<bool(const BlockGraph::Block*)> DecompositionPredicate;
+
+// The type of callback used by IterateBlockGraphConcurrently for the blocks
+// that were basic-block decomposed ahead of time.
+typedef base::Callback<bool(BlockGraph* block_graph,
+                            BlockGraph::Block* block,
+                            BasicBlockSubGraph* subgraph)>
+    DecomposedIterationCallback;
+
+// A variant of IterateBlockGraph that basic-block decomposes the blocks
+// selected by @p predicate concurrently, on up to @p num_threads worker
+// threads. The callbacks are still invoked serially, on the calling thread,
+// and in the same order as IterateBlockGraph would, so the outcome is
+// identical.
+//
+// To this end, blocks are handled in windows of consecutive blocks that
+// neither reference nor are referenced by any other decomposed block in the
+// same window. All of a window's blocks are decomposed before the first of them
+// is handed to a callback. Beyond the constraints of IterateBlockGraph, this
+// requires that @p callback leave the references of all blocks unchanged, and
+// that @p decomposed_callback not add references to any other block selected
+// by @p predicate.
+//
+// @param predicate the callback that selects the blocks to decompose. This is
+//     invoked on the calling thread, possibly more than once per block.
+// @param callback the callback to invoke for each pre-existing block that is
+//     not decomposed.
+// @param decomposed_callback the callback to invoke with the decomposition of
+//     each pre-existing block that is decomposed. This is responsible for
+//     merging the subgraph back into the block graph.
+// @param num_threads the maximum number of worker threads to use.
+// @param block_graph the block graph that is to be iterated.
+// @returns true on success, false if a decomposition or a callback fails.
+bool IterateBlockGraphConcurrently(
+    const DecompositionPredicate& predicate,
+    const IterationCallback& callback,
+    const DecomposedIterationCallback& decomposed_callback,
+    size_t num_threads,
+    BlockGraph* block_graph);
+
 }  // namespace block_graph
 
 #endif  // SYZYGY_BLOCK_GRAPH_ITERATE_H_
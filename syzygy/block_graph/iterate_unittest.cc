@@ -19,6 +19,8 @@
 #include "base/bind.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "syzygy/block_graph/basic_block_test_util.h"
+#include "syzygy/block_graph/block_builder.h"
 
 namespace block_graph {
 
@@ -68,6 +70,85 @@ class MockIterationCallback {
   }
 };
 
+class ConcurrentIterationTest : public testing::BasicBlockTest {
+ public:
+  // Makes a copy of assembly_func_, which references func1_ and func2_ but
+  // is otherwise unrelated to it.
+  void CopyAssemblyFunc() {
+    ASSERT_TRUE(assembly_func_ != NULL);
+    Block* copy = block_graph_.AddBlock(BlockGraph::CODE_BLOCK,
+                                        assembly_func_->size(),
+                                        "assembly_func_copy");
+    ASSERT_TRUE(copy != NULL);
+    copy->SetData(assembly_func_->data(), assembly_func_->data_size());
+    copy->set_attributes(assembly_func_->attributes());
+    copy->set_section(assembly_func_->section());
+    copy->set_alignment(assembly_func_->alignment());
+    copy->source_ranges() = assembly_func_->source_ranges();
+
+    Block::LabelMap::const_iterator label_it =
+        assembly_func_->labels().begin();
+    for (; label_it != assembly_func_->labels().end(); ++label_it)
+      ASSERT_TRUE(copy->SetLabel(label_it->first, label_it->second));
+
+    Block::ReferenceMap::const_iterator ref_it =
+        assembly_func_->references().begin();
+    for (; ref_it != assembly_func_->references().end(); ++ref_it) {
+      Reference ref = ref_it->second;
+      if (ref.referenced() == assembly_func_) {
+        ref = Reference(ref.type(), ref.size(), copy, ref.offset(),
+                        ref.base());
+      }
+      ASSERT_TRUE(copy->SetReference(ref_it->first, ref));
+    }
+  }
+
+  bool ShouldDecompose(const Block* block) {
+    return block->type() == BlockGraph::CODE_BLOCK &&
+        (block->attributes() & BlockGraph::BUILT_BY_SYZYGY) != 0;
+  }
+
+  bool OnBlock(BlockGraph* block_graph, Block* block) {
+    visited_.push_back(block->id());
+    return true;
+  }
+
+  bool OnDecomposedBlock(BlockGraph* block_graph,
+                         Block* block,
+                         BasicBlockSubGraph* subgraph) {
+    visited_.push_back(block->id());
+    decomposed_.push_back(block->id());
+    EXPECT_EQ(block, subgraph->original_block());
+
+    BlockBuilder builder(block_graph);
+    return builder.Merge(subgraph);
+  }
+
+  bool Iterate(size_t num_threads) {
+    return IterateBlockGraphConcurrently(
+        base::Bind(&ConcurrentIterationTest::ShouldDecompose,
+                   base::Unretained(this)),
+        base::Bind(&ConcurrentIterationTest::OnBlock,
+                   base::Unretained(this)),
+        base::Bind(&ConcurrentIterationTest::OnDecomposedBlock,
+                   base::Unretained(this)),
+        num_threads,
+        &block_graph_);
+  }
+
+  // Returns the IDs of the blocks in the block graph, in iteration order.
+  std::vector<BlockGraph::BlockId> GetBlockIds() {
+    std::vector<BlockGraph::BlockId> ids;
+    BlockGraph::BlockMap::const_iterator it = block_graph_.blocks().begin();
+    for (; it != block_graph_.blocks().end(); ++it)
+      ids.push_back(it->first);
+    return ids;
+  }
+
+  std::vector<BlockGraph::BlockId> visited_;
+  std::vector<BlockGraph::BlockId> decomposed_;
+};
+
 }  // namespace
 
 TEST_F(IterationTest, Iterate) {
@@ -128,4 +209,45 @@ TEST_F(IterationTest, IterateDeleteAdd) {
   EXPECT_EQ(3u, block_graph_.blocks().size());
 }
 
+TEST_F(ConcurrentIterationTest, IterateEmpty) {
+  EXPECT_TRUE(Iterate(2));
+  EXPECT_TRUE(visited_.empty());
+}
+
+TEST_F(ConcurrentIterationTest, IterateSingleThreaded) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+  std::vector<BlockGraph::BlockId> ids = GetBlockIds();
+  BlockGraph::BlockId assembly_func_id = assembly_func_->id();
+
+  EXPECT_TRUE(Iterate(1));
+  EXPECT_EQ(ids, visited_);
+  ASSERT_EQ(1u, decomposed_.size());
+  EXPECT_EQ(assembly_func_id, decomposed_[0]);
+
+  // The original block has been replaced by the merged one, and the data
+  // block now refers to the latter.
+  EXPECT_TRUE(block_graph_.GetBlockById(assembly_func_id) == NULL);
+  EXPECT_EQ(ids.size(), block_graph_.blocks().size());
+  Reference ref;
+  ASSERT_TRUE(data_->GetReference(0, &ref));
+  EXPECT_NE(assembly_func_id, ref.referenced()->id());
+}
+
+TEST_F(ConcurrentIterationTest, IterateMultiThreaded) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+  ASSERT_NO_FATAL_FAILURE(CopyAssemblyFunc());
+  std::vector<BlockGraph::BlockId> ids = GetBlockIds();
+
+  // Both copies of the function are decomposed, in order.
+  EXPECT_TRUE(Iterate(4));
+  EXPECT_EQ(ids, visited_);
+  ASSERT_EQ(2u, decomposed_.size());
+  EXPECT_LT(decomposed_[0], decomposed_[1]);
+  EXPECT_EQ(ids.size(), block_graph_.blocks().size());
+
+  // Both have been replaced by their merged counterparts.
+  for (size_t i = 0; i < decomposed_.size(); ++i)
+    EXPECT_TRUE(block_graph_.GetBlockById(decomposed_[i]) == NULL);
+}
+
 }  // namespace block_graph
@@ -0,0 +1,184 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/block_graph/lazy_block_graph_loader.h"
+
+#include <algorithm>
+
+namespace block_graph {
+
+namespace {
+
+// An input stream reading from a buffer, which keeps track of its position.
+class BufferInStream : public core::InStream {
+ public:
+  BufferInStream(const uint8* data, size_t size)
+      : data_(data), size_(size), position_(0) {
+    DCHECK(data != NULL);
+  }
+
+  size_t position() const { return position_; }
+
+ protected:
+  virtual bool ReadImpl(size_t length,
+                        core::Byte* bytes,
+                        size_t* bytes_read) OVERRIDE {
+    DCHECK(bytes != NULL);
+    DCHECK(bytes_read != NULL);
+
+    *bytes_read = std::min(length, size_ - position_);
+    ::memcpy(bytes, data_ + position_, *bytes_read);
+    position_ += *bytes_read;
+    return true;
+  }
+
+ private:
+  const uint8* data_;
+  size_t size_;
+  size_t position_;
+};
+
+}  // namespace
+
+LazyBlockGraphLoader::LazyBlockGraphLoader() : data_(NULL), size_(0) {
+}
+
+bool LazyBlockGraphLoader::Init(const uint8* data, size_t size) {
+  DCHECK(data != NULL);
+  DCHECK(data_ == NULL);
+
+  BufferInStream in_stream(data, size);
+  core::InArchive in_archive(&in_stream);
+  if (!LoadHeader(&in_archive))
+    return false;
+
+  if (!has_attributes(BLOCK_INDEX)) {
+    LOG(ERROR) << "The block-graph was serialized without a block index.";
+    return false;
+  }
+
+  BlockIndex index;
+  if (!LoadBlockGraphProperties(&block_graph_, &in_archive) ||
+      !LoadBlockIndex(&index, &in_archive)) {
+    LOG(ERROR) << "Unable to load block index.";
+    return false;
+  }
+
+  // The block records follow the index, and are followed by the reference
+  // records.
+  size_t blocks_size = 0;
+  size_t references_size = 0;
+  for (size_t i = 0; i < index.size(); ++i) {
+    blocks_size += index[i].block_size;
+    references_size += index[i].references_size;
+  }
+  size_t block_offset = in_stream.position();
+  if (blocks_size > size - block_offset ||
+      references_size > size - block_offset - blocks_size) {
+    LOG(ERROR) << "The block index doesn't match the size of the data.";
+    return false;
+  }
+
+  size_t references_offset = block_offset + blocks_size;
+  for (size_t i = 0; i < index.size(); ++i) {
+    Entry entry;
+    entry.block_offset = block_offset;
+    entry.block_size = index[i].block_size;
+    entry.references_offset = references_offset;
+    entry.references_size = index[i].references_size;
+    if (!entries_.insert(std::make_pair(index[i].id, entry)).second) {
+      LOG(ERROR) << "Duplicate block id " << index[i].id << " in index.";
+      return false;
+    }
+
+    block_offset += entry.block_size;
+    references_offset += entry.references_size;
+  }
+
+  data_ = data;
+  size_ = size;
+  return true;
+}
+
+BlockGraph::Block* LazyBlockGraphLoader::GetBlock(BlockId id) {
+  DCHECK(data_ != NULL);
+
+  BlockGraph::Block* block = block_graph_.GetBlockById(id);
+  if (block != NULL)
+    return block;
+
+  EntryMap::const_iterator it = entries_.find(id);
+  if (it == entries_.end()) {
+    LOG(ERROR) << "No block with id " << id << ".";
+    return NULL;
+  }
+
+  BufferInStream in_stream(data_ + it->second.block_offset,
+                           it->second.block_size);
+  core::InArchive in_archive(&in_stream);
+  if (!LoadBlock(&block_graph_, id, &in_archive) ||
+      in_stream.position() != it->second.block_size) {
+    LOG(ERROR) << "Unable to load block with id " << id << ".";
+    // Don't leave a partially loaded block behind.
+    block_graph_.RemoveBlockById(id);
+    return NULL;
+  }
+
+  block = block_graph_.GetBlockById(id);
+  DCHECK(block != NULL);
+  return block;
+}
+
+bool LazyBlockGraphLoader::LoadReferences(BlockId id) {
+  BlockGraph::Block* block = GetBlock(id);
+  if (block == NULL)
+    return false;
+
+  Entry& entry = entries_[id];
+  if (entry.references_loaded)
+    return true;
+
+  BufferInStream in_stream(data_ + entry.references_offset,
+                           entry.references_size);
+  core::InArchive in_archive(&in_stream);
+  if (!LoadBlockReferences(&block_graph_, block, &in_archive) ||
+      in_stream.position() != entry.references_size) {
+    LOG(ERROR) << "Unable to load references for block with id " << id << ".";
+    return false;
+  }
+
+  entry.references_loaded = true;
+  return true;
+}
+
+bool LazyBlockGraphLoader::LoadAll() {
+  EntryMap::const_iterator it = entries_.begin();
+  for (; it != entries_.end(); ++it) {
+    if (!LoadReferences(it->first))
+      return false;
+  }
+
+  return true;
+}
+
+BlockGraph::Block* LazyBlockGraphLoader::GetReferencedBlock(
+    BlockGraph* block_graph, BlockId id) const {
+  DCHECK_EQ(&block_graph_, block_graph);
+
+  // Loading a block doesn't change the serialized block-graph, it only
+  // materializes more of it.
+  return const_cast<LazyBlockGraphLoader*>(this)->GetBlock(id);
+}
+
+}  // namespace block_graph
@@ -0,0 +1,115 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a loader that deserializes the blocks of a block-graph on demand.
+
+#ifndef SYZYGY_BLOCK_GRAPH_LAZY_BLOCK_GRAPH_LOADER_H_
+#define SYZYGY_BLOCK_GRAPH_LAZY_BLOCK_GRAPH_LOADER_H_
+
+#include <map>
+
+#include "syzygy/block_graph/block_graph_serializer.h"
+
+namespace block_graph {
+
+// Loads the blocks of a block-graph serialized with the BLOCK_INDEX attribute
+// on demand. Only the header, the block-graph properties and the block index
+// are read up front; the properties, labels and data of a block are read on
+// its first access, and its references when they are asked for. This lets
+// tools that only look at a few blocks skip deserializing the rest. Sample
+// usage:
+//
+//   LazyBlockGraphLoader loader;
+//   loader.set_load_block_data_callback(callback);
+//   if (!loader.Init(data, size))
+//     return false;
+//   BlockGraph::Block* block = loader.GetBlock(id);
+//   if (block == NULL || !loader.LoadReferences(id))
+//     return false;
+//
+// The serialized data is typically a view of a memory mapped file, and must
+// outlive the loader.
+class LazyBlockGraphLoader : public BlockGraphSerializer {
+ public:
+  typedef BlockGraph::BlockId BlockId;
+
+  LazyBlockGraphLoader();
+
+  // Reads the header, the properties and the block index of a serialized
+  // block-graph. This can only be called once.
+  // @param data the serialized block-graph.
+  // @param size the size of @p data, in bytes.
+  // @returns true on success, false if the data is invalid or if the
+  //     block-graph was serialized without a block index.
+  bool Init(const uint8* data, size_t size);
+
+  // @returns the block-graph holding the blocks loaded so far.
+  BlockGraph* block_graph() { return &block_graph_; }
+
+  // @returns the number of blocks in the serialized block-graph.
+  size_t block_count() const { return entries_.size(); }
+
+  // Gets a block, loading its properties, labels and data on first access.
+  // Its references aren't loaded.
+  // @param id the ID of the block.
+  // @returns the block, or NULL if there is no such block or if it couldn't
+  //     be loaded.
+  BlockGraph::Block* GetBlock(BlockId id);
+
+  // Loads the references of a block, along with the blocks they refer to.
+  // The references of the referenced blocks aren't loaded.
+  // @param id the ID of the block.
+  // @returns true on success, false otherwise.
+  bool LoadReferences(BlockId id);
+
+  // Loads all of the blocks, and all of their references.
+  // @returns true on success, false otherwise.
+  bool LoadAll();
+
+ protected:
+  // Loads the referenced blocks on demand.
+  virtual BlockGraph::Block* GetReferencedBlock(
+      BlockGraph* block_graph, BlockId id) const OVERRIDE;
+
+ private:
+  // The location of the records of a block.
+  struct Entry {
+    Entry() : block_offset(0), block_size(0), references_offset(0),
+              references_size(0), references_loaded(false) {
+    }
+
+    size_t block_offset;
+    size_t block_size;
+    size_t references_offset;
+    size_t references_size;
+    bool references_loaded;
+  };
+  typedef std::map<BlockId, Entry> EntryMap;
+
+  // The serialized block-graph.
+  const uint8* data_;
+  size_t size_;
+
+  // The location of the records of each block.
+  EntryMap entries_;
+
+  // The blocks loaded so far.
+  BlockGraph block_graph_;
+
+  DISALLOW_COPY_AND_ASSIGN(LazyBlockGraphLoader);
+};
+
+}  // namespace block_graph
+
+#endif  // SYZYGY_BLOCK_GRAPH_LAZY_BLOCK_GRAPH_LOADER_H_
@@ -0,0 +1,140 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/block_graph/lazy_block_graph_loader.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/unittest_util.h"
+#include "syzygy/core/serialization.h"
+
+namespace block_graph {
+
+namespace {
+
+const uint8 kData[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+class LazyBlockGraphLoaderTest : public ::testing::Test {
+ public:
+  LazyBlockGraphLoaderTest() : code1_(NULL), code2_(NULL), data_(NULL) {
+  }
+
+  virtual void SetUp() OVERRIDE {
+    BlockGraph::Section* text = bg_.AddSection(".text", 1 | 4);
+    BlockGraph::Section* data = bg_.AddSection(".data", 2);
+
+    code1_ = bg_.AddBlock(BlockGraph::CODE_BLOCK, 8, "code1");
+    code2_ = bg_.AddBlock(BlockGraph::CODE_BLOCK, 8, "code2");
+    data_ = bg_.AddBlock(BlockGraph::DATA_BLOCK, 8, "data");
+    code1_->set_section(text->id());
+    code2_->set_section(text->id());
+    data_->set_section(data->id());
+    code1_->SetData(kData, sizeof(kData));
+    code2_->SetData(kData, sizeof(kData));
+    data_->SetData(kData, sizeof(kData));
+
+    code1_->SetLabel(0, BlockGraph::Label("code1", BlockGraph::CODE_LABEL));
+    code2_->SetLabel(0, BlockGraph::Label("code2", BlockGraph::CODE_LABEL));
+    code2_->SetLabel(4, BlockGraph::Label("data", BlockGraph::DATA_LABEL));
+
+    code1_->SetReference(0, BlockGraph::Reference(
+        BlockGraph::PC_RELATIVE_REF, 4, code2_, 0, 0));
+    code1_->SetReference(4, BlockGraph::Reference(
+        BlockGraph::ABSOLUTE_REF, 4, data_, 4, 4));
+    code2_->SetReference(0, BlockGraph::Reference(
+        BlockGraph::ABSOLUTE_REF, 4, data_, 0, 0));
+  }
+
+  void Serialize(BlockGraphSerializer::Attributes attributes) {
+    buffer_.clear();
+    scoped_ptr<core::OutStream> out_stream(
+        core::CreateByteOutStream(std::back_inserter(buffer_)));
+    core::NativeBinaryOutArchive out_archive(out_stream.get());
+
+    BlockGraphSerializer serializer;
+    serializer.set_data_mode(BlockGraphSerializer::OUTPUT_ALL_DATA);
+    serializer.set_attributes(attributes);
+    ASSERT_TRUE(serializer.Save(bg_, &out_archive));
+    ASSERT_FALSE(buffer_.empty());
+  }
+
+  BlockGraph bg_;
+  BlockGraph::Block* code1_;
+  BlockGraph::Block* code2_;
+  BlockGraph::Block* data_;
+  std::vector<uint8> buffer_;
+};
+
+}  // namespace
+
+TEST_F(LazyBlockGraphLoaderTest, FailsWithoutBlockIndex) {
+  ASSERT_NO_FATAL_FAILURE(Serialize(BlockGraphSerializer::DEFAULT_ATTRIBUTES));
+
+  LazyBlockGraphLoader loader;
+  EXPECT_FALSE(loader.Init(buffer_.data(), buffer_.size()));
+}
+
+TEST_F(LazyBlockGraphLoaderTest, FailsWithTruncatedData) {
+  ASSERT_NO_FATAL_FAILURE(Serialize(BlockGraphSerializer::BLOCK_INDEX));
+
+  LazyBlockGraphLoader loader;
+  EXPECT_FALSE(loader.Init(buffer_.data(), buffer_.size() - 1));
+}
+
+TEST_F(LazyBlockGraphLoaderTest, LoadsBlocksOnDemand) {
+  ASSERT_NO_FATAL_FAILURE(Serialize(BlockGraphSerializer::BLOCK_INDEX));
+
+  LazyBlockGraphLoader loader;
+  ASSERT_TRUE(loader.Init(buffer_.data(), buffer_.size()));
+  EXPECT_EQ(3u, loader.block_count());
+  EXPECT_EQ(0u, loader.block_graph()->blocks().size());
+  EXPECT_EQ(2u, loader.block_graph()->sections().size());
+
+  // Getting a block only loads that block, without its references.
+  BlockGraph::Block* code2 = loader.GetBlock(code2_->id());
+  ASSERT_TRUE(code2 != NULL);
+  EXPECT_EQ(1u, loader.block_graph()->blocks().size());
+  EXPECT_EQ(code2_->name(), code2->name());
+  EXPECT_EQ(code2_->labels(), code2->labels());
+  ASSERT_EQ(sizeof(kData), code2->data_size());
+  EXPECT_EQ(0, ::memcmp(kData, code2->data(), sizeof(kData)));
+  EXPECT_TRUE(code2->references().empty());
+  EXPECT_EQ(code2, loader.GetBlock(code2_->id()));
+
+  // Loading its references loads the referenced block.
+  ASSERT_TRUE(loader.LoadReferences(code2_->id()));
+  EXPECT_EQ(2u, loader.block_graph()->blocks().size());
+  EXPECT_EQ(1u, code2->references().size());
+  BlockGraph::Block* data = loader.GetBlock(data_->id());
+  ASSERT_TRUE(data != NULL);
+  EXPECT_EQ(1u, data->referrers().size());
+  EXPECT_TRUE(data->references().empty());
+
+  // Loading them again is a no-op.
+  ASSERT_TRUE(loader.LoadReferences(code2_->id()));
+  EXPECT_EQ(1u, code2->references().size());
+
+  EXPECT_TRUE(loader.GetBlock(1234) == NULL);
+}
+
+TEST_F(LazyBlockGraphLoaderTest, LoadAll) {
+  ASSERT_NO_FATAL_FAILURE(Serialize(BlockGraphSerializer::BLOCK_INDEX |
+                                    BlockGraphSerializer::DELTA_ENCODING));
+
+  LazyBlockGraphLoader loader;
+  ASSERT_TRUE(loader.Init(buffer_.data(), buffer_.size()));
+  ASSERT_TRUE(loader.LoadAll());
+  EXPECT_TRUE(testing::BlockGraphsEqual(bg_, *loader.block_graph(), loader));
+}
+
+}  // namespace block_graph
@@ -243,6 +243,46 @@ void OrderedBlockGraph::PlaceAtHead(const Section* section,
   DCHECK_EQ(*(block_info->it), block);
 }
 
+void OrderedBlockGraph::PlaceAtHead(const Section* section,
+                                    const BlockVector& blocks) {
+  SectionInfo* section_info = GetSectionInfo(section);
+  DCHECK(section_info != NULL);
+
+  // Splice the blocks out of their current lists and onto a scratch list, so
+  // that they can all be moved into place with a single splice. While a block
+  // lives in the scratch list its ordered section is NULL, which is how we
+  // recognize repeated blocks.
+  BlockList placed;
+  std::vector<BlockInfo*> placed_infos;
+  placed_infos.reserve(blocks.size());
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    Block* block = blocks[i];
+    DCHECK(block != NULL);
+
+    BlockInfo* block_info = GetBlockInfo(block);
+    DCHECK(block_info != NULL);
+    if (block_info->ordered_section == NULL)
+      continue;
+
+    placed.splice(placed.end(),
+                  block_info->ordered_section->ordered_blocks_,
+                  block_info->it);
+    block_info->ordered_section = NULL;
+    block->set_section(section_info->id());
+    placed_infos.push_back(block_info);
+  }
+
+  BlockList& section_blocks(section_info->ordered_section.ordered_blocks_);
+  section_blocks.splice(section_blocks.begin(), placed);
+
+  // Splice invalidates the iterators, so update them in a single walk.
+  BlockList::iterator it = section_blocks.begin();
+  for (size_t i = 0; i < placed_infos.size(); ++i, ++it) {
+    placed_infos[i]->it = it;
+    placed_infos[i]->ordered_section = &section_info->ordered_section;
+  }
+}
+
 void OrderedBlockGraph::PlaceAtTail(const Section* section,
                                     BlockGraph::Block* block) {
   DCHECK(block != NULL);
@@ -33,6 +33,10 @@
 //   // Make sure that .text comes first.
 //   ordered.PlaceAtHead(some_block_graph->GetSectionByName(".text"));
 //
+//   // Place some known blocks at the start of the data, in order.
+//   ordered.PlaceAtHead(some_block_graph->GetSectionByName(".data"),
+//                       some_block_vector);
+//
 //   // Sort the text blocks according to some functor.
 //   ordered.Sort(some_block_graph->GetSectionByName(".text"),
 //                some_sort_functor);
@@ -174,6 +178,19 @@ class OrderedBlockGraph {
   // @param block the block to be moved.
   void PlaceAtHead(const Section* section, Block* block);
 
+  // Moves the given blocks to the head of the given section, in the order in
+  // which they are provided. Blocks that do not belong to that section will
+  // have their section_id updated. Blocks already in the section but not
+  // provided keep their relative order, and follow the provided blocks. This
+  // is equivalent to calling PlaceAtHead on each block in reverse order, but
+  // applies a whole order in a single pass.
+  //
+  // @param section the section into which the blocks should be placed. May be
+  //     NULL, indicating that the blocks lie outside of all known sections.
+  // @param blocks the blocks to be moved, in order. If a block is provided
+  //     more than once only its first occurrence is used.
+  void PlaceAtHead(const Section* section, const BlockVector& blocks);
+
   // Moves the given block to the tail of the given section. If the block does
   // not belong to that section it will have its section_id updated.
   //
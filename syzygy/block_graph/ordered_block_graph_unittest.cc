@@ -263,6 +263,32 @@ TEST_F(OrderedBlockGraphTest, BlockPlaceAtHead) {
   EXPECT_TRUE(ordered.IndicesAreValid());
 }
 
+TEST_F(OrderedBlockGraphTest, BlockPlaceAtHeadMany) {
+  InitBlockGraph(2, 3, 0);
+  TestOrderedBlockGraph ordered(&block_graph_);
+  EXPECT_SECTION_CONTAINS(ordered, 0, 1, 2, 3);
+  EXPECT_SECTION_CONTAINS(ordered, 1, 4, 5, 6);
+  BlockGraph::Section* section0 = block_graph_.GetSectionById(0);
+
+  // Placing nothing should be a noop.
+  ordered.PlaceAtHead(section0, BlockVector());
+  EXPECT_SECTION_CONTAINS(ordered, 0, 1, 2, 3);
+  EXPECT_TRUE(ordered.IndicesAreValid());
+
+  // This should pull a block from another section, and keep the blocks that
+  // aren't mentioned at the end. Repeated blocks are placed once.
+  BlockVector blocks;
+  blocks.push_back(block_graph_.GetBlockById(3));
+  blocks.push_back(block_graph_.GetBlockById(5));
+  blocks.push_back(block_graph_.GetBlockById(1));
+  blocks.push_back(block_graph_.GetBlockById(3));
+  ordered.PlaceAtHead(section0, blocks);
+  EXPECT_SECTION_CONTAINS(ordered, 0, 3, 5, 1, 2);
+  EXPECT_SECTION_CONTAINS(ordered, 1, 4, 6);
+  EXPECT_EQ(0, block_graph_.GetBlockById(5)->section());
+  EXPECT_TRUE(ordered.IndicesAreValid());
+}
+
 TEST_F(OrderedBlockGraphTest, BlockPlaceAtTail) {
   InitBlockGraph(0, 0, 3);
   TestOrderedBlockGraph ordered(&block_graph_);
@@ -72,13 +72,28 @@ bool ApplyBasicBlockSubGraphTransform(
   if (!bb_decomposer.Decompose())
     return false;
 
+  return ApplyBasicBlockSubGraphTransformToSubGraph(
+      transform, policy, block_graph, &subgraph, new_blocks);
+}
+
+bool ApplyBasicBlockSubGraphTransformToSubGraph(
+    BasicBlockSubGraphTransformInterface* transform,
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BasicBlockSubGraph* subgraph,
+    BlockVector* new_blocks) {
+  DCHECK(transform != NULL);
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+  DCHECK(subgraph != NULL);
+
   // Call the transform.
-  if (!transform->TransformBasicBlockSubGraph(policy, block_graph, &subgraph))
+  if (!transform->TransformBasicBlockSubGraph(policy, block_graph, subgraph))
     return false;
 
   // Update the block-graph post transform.
   BlockBuilder builder(block_graph);
-  if (!builder.Merge(&subgraph))
+  if (!builder.Merge(subgraph))
     return false;
 
   if (new_blocks != NULL) {
@@ -103,6 +103,26 @@ bool ApplyBasicBlockSubGraphTransform(
     BlockGraph::Block* block,
     BlockVector* new_blocks);
 
+// Applies the provided BasicBlockSubGraphTransform to a block that has already
+// been basic-block decomposed. Passes the subgraph to the transform, and
+// recomposes the block.
+//
+// @param transform the transform to apply.
+// @param policy The policy object restricting how the transform is applied.
+// @param block_graph the block containing the block to be transformed.
+// @param subgraph the basic-block decomposition of the block to be
+//     transformed.
+// @param new_blocks On success, any newly created blocks will be returned
+//     here. Note that this parameter may be NULL if you are not interested
+//     in retrieving the set of new blocks.
+// @returns true on success, false otherwise.
+bool ApplyBasicBlockSubGraphTransformToSubGraph(
+    BasicBlockSubGraphTransformInterface* transform,
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BasicBlockSubGraph* subgraph,
+    BlockVector* new_blocks);
+
 }  // namespace block_graph
 
 #endif  // SYZYGY_BLOCK_GRAPH_TRANSFORM_H_
@@ -33,11 +33,18 @@ namespace transforms {
 //
 //   static const char DerivedType::kTransformName[];
 //
+// A derived class whose per-block work consists of basic-block decomposing
+// blocks and transforming them independently of the other blocks may also
+// implement 'ShouldDecomposeBlock' and 'OnDecomposedBlock'. If it does, the
+// decompositions can be done concurrently. See set_decomposition_threads.
+//
 // @tparam DerivedType the type of the derived class.
 template<class DerivedType>
 class IterativeTransformImpl
     : public NamedBlockGraphTransformImpl<DerivedType> {
  public:
+  IterativeTransformImpl() : decomposition_threads_(1) { }
+
   // This is the main body of the transform. This takes care of calling Pre,
   // iterating through the blocks and calling OnBlock for each one, and finally
   // calling Post. If any step fails the entire transform fails.
@@ -50,6 +57,21 @@ class IterativeTransformImpl
                                    BlockGraph* block_graph,
                                    BlockGraph::Block* header_block) OVERRIDE;
 
+  // Sets the number of worker threads used to basic-block decompose the blocks
+  // selected by ShouldDecomposeBlock. When this is greater than one, the
+  // blocks are decomposed concurrently ahead of being handed to
+  // OnDecomposedBlock, which is still called serially and in block order, so
+  // the outcome is unchanged. See IterateBlockGraphConcurrently for the
+  // constraints this puts on the derived class. Defaults to 1.
+  // @param decomposition_threads the number of worker threads to use.
+  void set_decomposition_threads(size_t decomposition_threads) {
+    decomposition_threads_ = decomposition_threads;
+  }
+
+  // @returns the number of worker threads used to basic-block decompose
+  //     blocks.
+  size_t decomposition_threads() const { return decomposition_threads_; }
+
  protected:
   // This function is called prior to the iterative portion of the transform.
   // If it fails, the rest of the transform will not run. A default
@@ -92,6 +114,42 @@ class IterativeTransformImpl
                                BlockGraph::Block* header_block) {
     return true;
   }
+
+  // This function is called when decomposing concurrently, to determine
+  // whether a block is to be basic-block decomposed and handed to
+  // OnDecomposedBlock, rather than to OnBlock. A default implementation is
+  // provided that selects no blocks, but it may be overridden.
+  //
+  // @param policy The policy object restricting how the transform is applied.
+  // @param block the block to evaluate.
+  // @returns true if @p block is to be decomposed, false otherwise.
+  bool ShouldDecomposeBlock(const TransformPolicyInterface* policy,
+                            const BlockGraph::Block* block) {
+    return false;
+  }
+
+  // This function is called when decomposing concurrently, in place of
+  // OnBlock, for every block selected by ShouldDecomposeBlock. It is
+  // responsible for merging @p subgraph back into the block graph. If it
+  // returns false the transform will be aborted and is considered to have
+  // failed. This must be implemented by derived classes that implement
+  // ShouldDecomposeBlock.
+  //
+  // @param policy The policy object restricting how the transform is applied.
+  // @param block_graph the block graph being transformed.
+  // @param block the block to process.
+  // @param subgraph the basic-block decomposition of @p block.
+  // @returns true on success, false otherwise.
+  bool OnDecomposedBlock(const TransformPolicyInterface* policy,
+                         BlockGraph* block_graph,
+                         BlockGraph::Block* block,
+                         BasicBlockSubGraph* subgraph) {
+    NOTREACHED();
+    return false;
+  }
+
+  // The number of worker threads used to basic-block decompose blocks.
+  size_t decomposition_threads_;
 };
 
 template <class DerivedType>
@@ -111,11 +169,27 @@ bool IterativeTransformImpl<DerivedType>::TransformBlockGraph(
     return false;
   }
 
-  bool result = IterateBlockGraph(
-      base::Bind(&DerivedType::OnBlock,
-                 base::Unretained(self),
-                 base::Unretained(policy)),
-      block_graph);
+  bool result = false;
+  if (decomposition_threads_ > 1) {
+    result = IterateBlockGraphConcurrently(
+        base::Bind(&DerivedType::ShouldDecomposeBlock,
+                   base::Unretained(self),
+                   base::Unretained(policy)),
+        base::Bind(&DerivedType::OnBlock,
+                   base::Unretained(self),
+                   base::Unretained(policy)),
+        base::Bind(&DerivedType::OnDecomposedBlock,
+                   base::Unretained(self),
+                   base::Unretained(policy)),
+        decomposition_threads_,
+        block_graph);
+  } else {
+    result = IterateBlockGraph(
+        base::Bind(&DerivedType::OnBlock,
+                   base::Unretained(self),
+                   base::Unretained(policy)),
+        block_graph);
+  }
   if (!result) {
     LOG(ERROR) << "Iteration failed for \"" << name() << "\" transform.";
     return false;
@@ -89,6 +89,8 @@
         'defs.h',
         'indexed_frequency_data.cc',
         'indexed_frequency_data.h',
+        'live_frequency_data.cc',
+        'live_frequency_data.h',
         'logging.cc',
         'logging.h',
         'path_util.cc',
@@ -104,6 +106,18 @@
       # files that from syzygy_version that are included from compiles.
       'hard_dependency': 1,
     },
+    {
+      'target_name': 'stage_profiler_lib',
+      'type': 'static_library',
+      'sources': [
+        'stage_profiler.cc',
+        'stage_profiler.h',
+      ],
+      'dependencies': [
+        '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/core/core.gyp:core_lib',
+      ],
+    },
     {
       'target_name': 'common_unittest_utils',
       'type': 'static_library',
@@ -124,13 +138,16 @@
         'application_unittest.cc',
         'buffer_writer_unittest.cc',
         'common_unittests_main.cc',
+        'live_frequency_data_unittest.cc',
         'path_util_unittest.cc',
+        'stage_profiler_unittest.cc',
         'unittest_util_unittest.cc',
         'syzygy_version_unittest.cc',
       ],
       'dependencies': [
         'common_lib',
         'common_unittest_utils',
+        'stage_profiler_lib',
         '<(src)/base/base.gyp:base',
         '<(src)/testing/gmock.gyp:gmock',
         '<(src)/testing/gtest.gyp:gtest',
@@ -28,6 +28,8 @@ const uint32 kBasicBlockFrequencyDataVersion = 1;
 const uint32 kBranchFrequencyDataVersion = 1;
 const uint32 kJumpTableFrequencyDataVersion = 1;
 
+const uint32 kEdgeCoverageBitmapSize = 1 << 16;
+
 const char kBasicBlockRangesStreamName[] = "/Syzygy/BasicBlockRanges";
 
 // This must be kept in sync with IndexedFrequencyDataType::DataType.
@@ -37,6 +39,8 @@ const char* IndexedFrequencyDataTypeName[] = {
   "branch",
   "coverage",
   "jumptable",
+  "edge-coverage",
+  "page-coverage",
 };
 COMPILE_ASSERT(arraysize(IndexedFrequencyDataTypeName) ==
     IndexedFrequencyData::MAX_DATA_TYPE, length_mismatch);
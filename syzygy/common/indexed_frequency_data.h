@@ -41,7 +41,9 @@ struct IndexedFrequencyData {
     BRANCH = 2,
     COVERAGE = 3,
     JUMP_TABLE = 4,
-    MAX_DATA_TYPE = 5,
+    EDGE_COVERAGE = 5,
+    PAGE_COVERAGE = 6,
+    MAX_DATA_TYPE = 7,
   };
 
   // An identifier denoting the agent with which this frequency data
@@ -69,7 +71,8 @@ struct IndexedFrequencyData {
   void* frequency_data;
 
   // The number of entries in the frequency table. This is required by the
-  // runtime client library so it knows how big an array to allocate.
+  // runtime client library so it knows how big an array to allocate. For page
+  // coverage the agent sets this itself, to the number of pages of the image.
   uint32 num_entries;
 
   // The number of columns for each entry.
@@ -91,6 +94,22 @@ struct IndexedFrequencyData {
 };
 COMPILE_ASSERT_IS_POD(IndexedFrequencyData);
 
+// This data structure is injected in place of IndexedFrequencyData by the edge
+// coverage instrumentation. Its frequency data is a bitmap of
+// kEdgeCoverageBitmapSize bytes, indexed by a hash of the edges between basic
+// blocks: entering a basic block sets the byte at the sum of its location and
+// of the previous location, then stores its own previous location.
+struct EdgeCoverageData {
+  // The indexed frequency data information common to all agents.
+  IndexedFrequencyData module_data;
+
+  // The previous location of the last basic block entered, in
+  // [0, kEdgeCoverageBitmapSize / 2). This is process-wide, so the edges of
+  // concurrent threads may get mixed up.
+  uint32 previous_location;
+};
+COMPILE_ASSERT_IS_POD(EdgeCoverageData);
+
 #pragma pack(pop)
 
 // The basic-block coverage agent ID.
@@ -111,6 +130,10 @@ extern const uint32 kBranchFrequencyDataVersion;
 // The jump table trace agent version.
 extern const uint32 kJumpTableFrequencyDataVersion;
 
+// The size of the edge coverage bitmap, in bytes. The basic block locations
+// are below half of it, so that their sums don't need to be masked.
+extern const uint32 kEdgeCoverageBitmapSize;
+
 // The name of the basic-block ranges stream added to the PDB by
 // any instrumentation employing basic-block trace data.
 extern const char kBasicBlockRangesStreamName[];
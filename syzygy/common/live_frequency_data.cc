@@ -0,0 +1,224 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/common/live_frequency_data.h"
+
+#include "base/logging.h"
+#include "base/stringprintf.h"
+#include "base/win/pe_image.h"
+#include "sawbuck/common/com_utils.h"
+
+namespace common {
+
+const char kLiveFrequencyDataEnvVar[] = "SYZYGY_LIVE_FREQUENCY_DATA_PREFIX";
+
+const uint32 kLiveFrequencyDataMagic = 0x5646594C;  // "LYFV".
+const uint32 kLiveFrequencyDataVersion = 1;
+
+std::wstring GetLiveFrequencyDataName(const std::wstring& prefix,
+                                      uint32 process_id,
+                                      const std::wstring& module_name) {
+  return base::StringPrintf(L"%ls-%u-%ls", prefix.c_str(), process_id,
+                            module_name.c_str());
+}
+
+LiveFrequencyData::LiveFrequencyData() : header_(NULL) {
+}
+
+LiveFrequencyData::~LiveFrequencyData() {
+  if (header_ != NULL) {
+    ::UnmapViewOfFile(header_);
+    header_ = NULL;
+  }
+}
+
+bool LiveFrequencyData::Create(const std::wstring& name,
+                               HMODULE module,
+                               const IndexedFrequencyData& data) {
+  DCHECK(!name.empty());
+  DCHECK(module != NULL);
+  DCHECK(header_ == NULL);
+
+  size_t data_size =
+      data.num_entries * data.num_columns * data.frequency_size;
+  size_t section_size = sizeof(LiveFrequencyDataHeader) + data_size;
+
+  mapping_.Set(::CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                   0, section_size, name.c_str()));
+  if (!mapping_.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to create live frequency data section \"" << name
+               << "\": " << com::LogWe(error) << ".";
+    return false;
+  }
+
+  // A stale section of the same name would have the wrong size and contents.
+  if (::GetLastError() == ERROR_ALREADY_EXISTS) {
+    LOG(ERROR) << "Live frequency data section \"" << name
+               << "\" already exists.";
+    mapping_.Close();
+    return false;
+  }
+
+  header_ = reinterpret_cast<LiveFrequencyDataHeader*>(
+      ::MapViewOfFile(mapping_.Get(), FILE_MAP_WRITE, 0, 0, 0));
+  if (header_ == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to map live frequency data section \"" << name
+               << "\": " << com::LogWe(error) << ".";
+    mapping_.Close();
+    return false;
+  }
+
+  // The section comes zero-initialized, so only the description needs to be
+  // filled in. The epoch starts at zero.
+  const base::win::PEImage image(module);
+  const IMAGE_NT_HEADERS* nt_headers = image.GetNTHeaders();
+  header_->version = kLiveFrequencyDataVersion;
+  header_->module_base_addr = reinterpret_cast<uint32>(image.module());
+  header_->module_base_size = nt_headers->OptionalHeader.SizeOfImage;
+  header_->module_checksum = nt_headers->OptionalHeader.CheckSum;
+  header_->module_time_date_stamp = nt_headers->FileHeader.TimeDateStamp;
+  header_->data_type = data.data_type;
+  header_->frequency_size = data.frequency_size;
+  header_->num_entries = data.num_entries;
+  header_->num_columns = data.num_columns;
+
+  // Publish the header last so readers never see a partial one.
+  ::MemoryBarrier();
+  header_->magic = kLiveFrequencyDataMagic;
+
+  return true;
+}
+
+bool LiveFrequencyData::Open(const std::wstring& name) {
+  DCHECK(!name.empty());
+  DCHECK(header_ == NULL);
+
+  mapping_.Set(::OpenFileMapping(FILE_MAP_WRITE, FALSE, name.c_str()));
+  if (!mapping_.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to open live frequency data section \"" << name
+               << "\": " << com::LogWe(error) << ".";
+    return false;
+  }
+
+  if (!MapView()) {
+    mapping_.Close();
+    return false;
+  }
+
+  return true;
+}
+
+void* LiveFrequencyData::frequency_data() const {
+  if (header_ == NULL)
+    return NULL;
+  return header_ + 1;
+}
+
+size_t LiveFrequencyData::frequency_data_size() const {
+  if (header_ == NULL)
+    return 0;
+  return header_->num_entries * header_->num_columns * header_->frequency_size;
+}
+
+void LiveFrequencyData::Snapshot(std::vector<uint8>* data,
+                                 uint32* epoch) const {
+  DCHECK(data != NULL);
+  DCHECK(epoch != NULL);
+  DCHECK(header_ != NULL);
+
+  const uint8* begin = reinterpret_cast<const uint8*>(frequency_data());
+  while (true) {
+    LONG start_epoch = header_->epoch;
+    if (start_epoch % 2 != 0) {
+      // A reset is in progress.
+      ::Sleep(0);
+      continue;
+    }
+
+    ::MemoryBarrier();
+    data->assign(begin, begin + frequency_data_size());
+    ::MemoryBarrier();
+
+    if (header_->epoch == start_epoch) {
+      *epoch = start_epoch / 2;
+      return;
+    }
+  }
+}
+
+void LiveFrequencyData::Reset() {
+  DCHECK(header_ != NULL);
+
+  // Concurrent resets are serialized by waiting for the epoch to be even.
+  while (true) {
+    LONG epoch = header_->epoch;
+    if (epoch % 2 == 0 &&
+        ::InterlockedCompareExchange(&header_->epoch, epoch + 1, epoch) ==
+            epoch) {
+      break;
+    }
+    ::Sleep(0);
+  }
+
+  ::memset(frequency_data(), 0, frequency_data_size());
+
+  ::InterlockedIncrement(&header_->epoch);
+}
+
+bool LiveFrequencyData::MapView() {
+  DCHECK(mapping_.IsValid());
+  DCHECK(header_ == NULL);
+
+  void* view = ::MapViewOfFile(mapping_.Get(), FILE_MAP_WRITE, 0, 0, 0);
+  if (view == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to map live frequency data section: "
+               << com::LogWe(error) << ".";
+    return false;
+  }
+
+  // The view is rounded up to a page, so it can be larger than the section.
+  MEMORY_BASIC_INFORMATION info = {};
+  if (::VirtualQuery(view, &info, sizeof(info)) == 0) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "VirtualQuery failed: " << com::LogWe(error) << ".";
+    ::UnmapViewOfFile(view);
+    return false;
+  }
+
+  LiveFrequencyDataHeader* header =
+      reinterpret_cast<LiveFrequencyDataHeader*>(view);
+  if (info.RegionSize < sizeof(*header) ||
+      header->magic != kLiveFrequencyDataMagic ||
+      header->version != kLiveFrequencyDataVersion) {
+    LOG(ERROR) << "Not a valid live frequency data section.";
+    ::UnmapViewOfFile(view);
+    return false;
+  }
+
+  header_ = header;
+  if (info.RegionSize < sizeof(*header) + frequency_data_size()) {
+    LOG(ERROR) << "Live frequency data section is truncated.";
+    header_ = NULL;
+    ::UnmapViewOfFile(view);
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace common
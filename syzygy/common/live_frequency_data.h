@@ -0,0 +1,145 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the shared memory layout through which the coverage and basic-block
+// agents expose the frequency data of an instrumented module while the
+// process is running, and a helper to create or open it.
+//
+// Each module gets a named section holding a LiveFrequencyDataHeader directly
+// followed by the frequency data that the instrumentation updates in place.
+// The section is named after a prefix given through kLiveFrequencyDataEnvVar,
+// the process id and the module's base name (see GetLiveFrequencyDataName),
+// so that an external reader can find it without talking to the agent.
+//
+// The counts can be reset by a reader at any time. A reset makes the epoch
+// odd, clears the counts and makes the epoch even again, so readers can tell
+// which epoch a copy of the counts belongs to, and retry if it overlapped a
+// reset. Increments racing with a reset may survive it, as the
+// instrumentation doesn't synchronize with readers; resets are meant to be
+// issued while the instrumented code is idle, e.g. between fuzz iterations.
+
+#ifndef SYZYGY_COMMON_LIVE_FREQUENCY_DATA_H_
+#define SYZYGY_COMMON_LIVE_FREQUENCY_DATA_H_
+
+#include <windows.h>
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/win/scoped_handle.h"
+#include "syzygy/common/assertions.h"
+#include "syzygy/common/indexed_frequency_data.h"
+
+namespace common {
+
+// The name of the environment variable holding the prefix of the live
+// frequency data sections. The agents only create them if it is set.
+extern const char kLiveFrequencyDataEnvVar[];
+
+// The magic number and version identifying a live frequency data section.
+extern const uint32 kLiveFrequencyDataMagic;
+extern const uint32 kLiveFrequencyDataVersion;
+
+#pragma pack(push, 1)
+
+// The header at the start of a live frequency data section.
+struct LiveFrequencyDataHeader {
+  // Set to kLiveFrequencyDataMagic and kLiveFrequencyDataVersion.
+  uint32 magic;
+  uint32 version;
+
+  // Identify the module the counts belong to.
+  uint32 module_base_addr;
+  uint32 module_base_size;
+  uint32 module_checksum;
+  uint32 module_time_date_stamp;
+
+  // Describe the frequency data that follows, as in IndexedFrequencyData.
+  uint32 data_type;
+  uint32 frequency_size;
+  uint32 num_entries;
+  uint32 num_columns;
+
+  // Twice the number of resets the counts went through, plus one while a
+  // reset is in progress.
+  volatile LONG epoch;
+
+  // Pads the header so that the frequency data is 8-byte aligned.
+  uint32 reserved;
+};
+COMPILE_ASSERT_IS_POD_OF_SIZE(LiveFrequencyDataHeader, 48);
+
+#pragma pack(pop)
+
+// Returns the name of the live frequency data section of a module.
+// @param prefix The prefix given through kLiveFrequencyDataEnvVar.
+// @param process_id The id of the instrumented process.
+// @param module_name The base name of the instrumented module.
+std::wstring GetLiveFrequencyDataName(const std::wstring& prefix,
+                                      uint32 process_id,
+                                      const std::wstring& module_name);
+
+// Owns a view of a live frequency data section.
+class LiveFrequencyData {
+ public:
+  LiveFrequencyData();
+  ~LiveFrequencyData();
+
+  // Creates the live frequency data section of a module. This is used by the
+  // agents.
+  // @param name The name of the section.
+  // @param module The instrumented module.
+  // @param data The frequency data of @p module. Only its description is
+  //     used; the caller is responsible for pointing its frequency_data to
+  //     frequency_data().
+  // @returns true on success, false otherwise.
+  bool Create(const std::wstring& name,
+              HMODULE module,
+              const IndexedFrequencyData& data);
+
+  // Opens an existing live frequency data section. This is used by readers.
+  // @param name The name of the section.
+  // @returns true on success, false otherwise.
+  bool Open(const std::wstring& name);
+
+  // @returns the header of the section, or NULL if none is open.
+  const LiveFrequencyDataHeader* header() const { return header_; }
+
+  // @returns the frequency data of the section, or NULL if none is open.
+  void* frequency_data() const;
+
+  // @returns the size of the frequency data, in bytes.
+  size_t frequency_data_size() const;
+
+  // Takes a copy of the frequency data that doesn't overlap a reset.
+  // @param data Receives the frequency data.
+  // @param epoch Receives the number of resets preceding the copy.
+  void Snapshot(std::vector<uint8>* data, uint32* epoch) const;
+
+  // Clears the frequency data, starting a new epoch.
+  void Reset();
+
+ private:
+  // Maps the whole section in and validates it.
+  bool MapView();
+
+  base::win::ScopedHandle mapping_;
+  LiveFrequencyDataHeader* header_;
+
+  DISALLOW_COPY_AND_ASSIGN(LiveFrequencyData);
+};
+
+}  // namespace common
+
+#endif  // SYZYGY_COMMON_LIVE_FREQUENCY_DATA_H_
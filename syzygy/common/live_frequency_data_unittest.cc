@@ -0,0 +1,111 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/common/live_frequency_data.h"
+
+#include "gtest/gtest.h"
+
+namespace common {
+
+namespace {
+
+const uint32 kNumEntries = 5;
+
+class LiveFrequencyDataTest : public testing::Test {
+ public:
+  virtual void SetUp() OVERRIDE {
+    ::memset(&data_, 0, sizeof(data_));
+    data_.agent_id = kBasicBlockEntryAgentId;
+    data_.version = kBasicBlockFrequencyDataVersion;
+    data_.num_entries = kNumEntries;
+    data_.num_columns = 1;
+    data_.frequency_size = sizeof(uint32);
+    data_.data_type = IndexedFrequencyData::BASIC_BLOCK_ENTRY;
+
+    name_ = GetLiveFrequencyDataName(L"LiveFrequencyDataTest",
+                                     ::GetCurrentProcessId(),
+                                     L"test.dll");
+  }
+
+ protected:
+  IndexedFrequencyData data_;
+  std::wstring name_;
+};
+
+}  // namespace
+
+TEST(LiveFrequencyDataNameTest, GetLiveFrequencyDataName) {
+  EXPECT_EQ(std::wstring(L"prefix-1234-foo.dll"),
+            GetLiveFrequencyDataName(L"prefix", 1234, L"foo.dll"));
+}
+
+TEST_F(LiveFrequencyDataTest, OpenFailsWithoutSection) {
+  LiveFrequencyData reader;
+  EXPECT_FALSE(reader.Open(name_));
+  EXPECT_TRUE(reader.header() == NULL);
+  EXPECT_TRUE(reader.frequency_data() == NULL);
+}
+
+TEST_F(LiveFrequencyDataTest, CreateAndRead) {
+  LiveFrequencyData writer;
+  ASSERT_TRUE(writer.Create(name_, ::GetModuleHandle(NULL), data_));
+  ASSERT_TRUE(writer.header() != NULL);
+  EXPECT_EQ(kNumEntries * sizeof(uint32), writer.frequency_data_size());
+
+  // A second section of the same name can't be created.
+  LiveFrequencyData duplicate;
+  EXPECT_FALSE(duplicate.Create(name_, ::GetModuleHandle(NULL), data_));
+
+  LiveFrequencyData reader;
+  ASSERT_TRUE(reader.Open(name_));
+  const LiveFrequencyDataHeader* header = reader.header();
+  ASSERT_TRUE(header != NULL);
+  EXPECT_EQ(kLiveFrequencyDataMagic, header->magic);
+  EXPECT_EQ(kLiveFrequencyDataVersion, header->version);
+  EXPECT_EQ(reinterpret_cast<uint32>(::GetModuleHandle(NULL)),
+            header->module_base_addr);
+  EXPECT_EQ(static_cast<uint32>(IndexedFrequencyData::BASIC_BLOCK_ENTRY),
+            header->data_type);
+  EXPECT_EQ(kNumEntries, header->num_entries);
+
+  // The counts updated by the writer are visible to the reader.
+  uint32* counters = reinterpret_cast<uint32*>(writer.frequency_data());
+  counters[1] = 3;
+  counters[4] = 7;
+
+  std::vector<uint8> snapshot;
+  uint32 epoch = 1;
+  reader.Snapshot(&snapshot, &epoch);
+  EXPECT_EQ(0U, epoch);
+  ASSERT_EQ(kNumEntries * sizeof(uint32), snapshot.size());
+  const uint32* snapshot_counters =
+      reinterpret_cast<const uint32*>(&snapshot[0]);
+  EXPECT_EQ(0U, snapshot_counters[0]);
+  EXPECT_EQ(3U, snapshot_counters[1]);
+  EXPECT_EQ(7U, snapshot_counters[4]);
+
+  // A reset clears the counts and starts a new epoch.
+  reader.Reset();
+  EXPECT_EQ(0U, counters[1]);
+  EXPECT_EQ(0U, counters[4]);
+
+  counters[2] = 1;
+  reader.Snapshot(&snapshot, &epoch);
+  EXPECT_EQ(1U, epoch);
+  snapshot_counters = reinterpret_cast<const uint32*>(&snapshot[0]);
+  EXPECT_EQ(0U, snapshot_counters[1]);
+  EXPECT_EQ(1U, snapshot_counters[2]);
+}
+
+}  // namespace common
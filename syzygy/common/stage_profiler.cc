@@ -0,0 +1,152 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/common/stage_profiler.h"
+
+#include <windows.h>  // NOLINT
+#include <psapi.h>
+
+#include "base/file_util.h"
+#include "base/lazy_instance.h"
+#include "base/logging.h"
+#include "syzygy/core/json_file_writer.h"
+
+namespace common {
+
+namespace {
+
+base::LazyInstance<StageProfiler>::Leaky static_stage_profiler =
+    LAZY_INSTANCE_INITIALIZER;
+
+}  // namespace
+
+StageProfiler* StageProfiler::Instance() {
+  return static_stage_profiler.Pointer();
+}
+
+bool StageProfiler::GetMemoryUsage(MemoryUsage* usage) {
+  DCHECK(usage != NULL);
+
+  PROCESS_MEMORY_COUNTERS counters = {};
+  if (!::GetProcessMemoryInfo(::GetCurrentProcess(), &counters,
+                              sizeof(counters))) {
+    return false;
+  }
+
+  usage->peak_working_set = counters.PeakWorkingSetSize;
+  usage->private_bytes = counters.PagefileUsage;
+  return true;
+}
+
+void StageProfiler::RecordStage(const base::StringPiece& stage,
+                                const base::TimeDelta& duration,
+                                const MemoryUsage& start,
+                                const MemoryUsage& end) {
+  base::AutoLock lock(lock_);
+  StageStats& stats = stages_[stage.as_string()];
+  ++stats.count;
+  stats.total_time += duration;
+  if (duration > stats.max_time)
+    stats.max_time = duration;
+  stats.peak_working_set = end.peak_working_set;
+  if (end.private_bytes > start.private_bytes) {
+    size_t growth = end.private_bytes - start.private_bytes;
+    if (growth > stats.max_private_bytes_growth)
+      stats.max_private_bytes_growth = growth;
+  }
+}
+
+void StageProfiler::GetStages(StageStatsMap* stages) const {
+  DCHECK(stages != NULL);
+
+  base::AutoLock lock(lock_);
+  *stages = stages_;
+}
+
+void StageProfiler::Clear() {
+  base::AutoLock lock(lock_);
+  stages_.clear();
+}
+
+bool StageProfiler::Save(core::JSONFileWriter* json) const {
+  DCHECK(json != NULL);
+
+  StageStatsMap stages;
+  GetStages(&stages);
+
+  if (!json->OpenDict())
+    return false;
+
+  StageStatsMap::const_iterator it = stages.begin();
+  for (; it != stages.end(); ++it) {
+    const StageStats& stats = it->second;
+    if (!json->OutputKey(it->first) ||
+        !json->OpenDict() ||
+        !json->OutputKey("count") ||
+        !json->OutputInteger(static_cast<int>(stats.count)) ||
+        !json->OutputKey("total_time_ms") ||
+        !json->OutputDouble(stats.total_time.InMillisecondsF()) ||
+        !json->OutputKey("max_time_ms") ||
+        !json->OutputDouble(stats.max_time.InMillisecondsF()) ||
+        !json->OutputKey("peak_working_set") ||
+        !json->OutputInteger(static_cast<int>(stats.peak_working_set)) ||
+        !json->OutputKey("max_private_bytes_growth") ||
+        !json->OutputInteger(
+            static_cast<int>(stats.max_private_bytes_growth)) ||
+        !json->CloseDict()) {
+      return false;
+    }
+  }
+
+  if (!json->CloseDict())
+    return false;
+
+  return true;
+}
+
+bool StageProfiler::SaveToFile(const base::FilePath& path) const {
+  DCHECK(!path.empty());
+
+  file_util::ScopedFILE file(file_util::OpenFile(path, "wb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Failed to open " << path.value() << " for writing.";
+    return false;
+  }
+
+  core::JSONFileWriter json(file.get(), true);
+  if (!Save(&json)) {
+    LOG(ERROR) << "Failed to write the profile to " << path.value() << ".";
+    return false;
+  }
+
+  return true;
+}
+
+ScopedStageTimer::ScopedStageTimer(const base::StringPiece& stage)
+    : stage_(stage.as_string()), start_time_(base::TimeTicks::Now()) {
+  StageProfiler::GetMemoryUsage(&start_usage_);
+}
+
+ScopedStageTimer::~ScopedStageTimer() {
+  base::TimeDelta duration = base::TimeTicks::Now() - start_time_;
+  StageProfiler::MemoryUsage end_usage;
+  StageProfiler::GetMemoryUsage(&end_usage);
+  StageProfiler::Instance()->RecordStage(
+      stage_, duration, start_usage_, end_usage);
+
+  LOG(INFO) << "Stage \"" << stage_ << "\" took "
+            << duration.InMillisecondsF() << " ms.";
+}
+
+}  // namespace common
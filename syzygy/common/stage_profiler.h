@@ -0,0 +1,147 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a process-wide profile of the time spent in, and the memory used
+// by, the stages of the Syzygy tools. A stage is timed by a ScopedStageTimer:
+//
+//   bool DoSomething() {
+//     common::ScopedStageTimer timer("do something");
+//     ...
+//   }
+//
+// The tools save the profile as JSON when given --profile-output, which is
+// the way to find their bottlenecks without an external profiler.
+
+#ifndef SYZYGY_COMMON_STAGE_PROFILER_H_
+#define SYZYGY_COMMON_STAGE_PROFILER_H_
+
+#include <map>
+#include <string>
+
+#include "base/string_piece.h"
+#include "base/time.h"
+#include "base/files/file_path.h"
+#include "base/synchronization/lock.h"
+
+namespace core {
+
+// Forward declaration.
+class JSONFileWriter;
+
+}  // namespace core
+
+namespace common {
+
+// A thread-safe accumulation of the time spent in the stages of a tool, keyed
+// by the name of the stage.
+class StageProfiler {
+ public:
+  // The statistics of a stage.
+  struct StageStats {
+    StageStats()
+        : count(0),
+          peak_working_set(0),
+          max_private_bytes_growth(0) {
+    }
+
+    // The number of times the stage ran.
+    size_t count;
+    // The total and longest time spent in the stage.
+    base::TimeDelta total_time;
+    base::TimeDelta max_time;
+    // The peak working set of the process when the stage last completed.
+    size_t peak_working_set;
+    // The largest growth of the private bytes of the process during a run of
+    // the stage.
+    size_t max_private_bytes_growth;
+  };
+  typedef std::map<std::string, StageStats> StageStatsMap;
+
+  // The memory usage of the process.
+  struct MemoryUsage {
+    MemoryUsage() : peak_working_set(0), private_bytes(0) {
+    }
+
+    size_t peak_working_set;
+    size_t private_bytes;
+  };
+
+  StageProfiler() { }
+
+  // @returns the process-wide profiler.
+  static StageProfiler* Instance();
+
+  // Gets the current memory usage of the process.
+  // @param usage Receives the memory usage.
+  // @returns true on success, false otherwise.
+  static bool GetMemoryUsage(MemoryUsage* usage);
+
+  // Records a run of a stage.
+  // @param stage The name of the stage.
+  // @param duration The time spent in the stage.
+  // @param start The memory usage of the process when the stage started.
+  // @param end The memory usage of the process when the stage completed.
+  void RecordStage(const base::StringPiece& stage,
+                   const base::TimeDelta& duration,
+                   const MemoryUsage& start,
+                   const MemoryUsage& end);
+
+  // Gets the statistics of the stages recorded so far.
+  // @param stages Receives the statistics.
+  void GetStages(StageStatsMap* stages) const;
+
+  // Forgets the stages recorded so far.
+  void Clear();
+
+  // Saves the profile as JSON. The profile is a dictionary keyed by the name
+  // of the stages, each of which is a dictionary of its statistics. The times
+  // are in milliseconds and the memory usages in bytes.
+  // @param json The JSON writer to use.
+  // @returns true on success, false otherwise.
+  bool Save(core::JSONFileWriter* json) const;
+
+  // Saves the profile as JSON to a file.
+  // @param path The path of the file to write.
+  // @returns true on success, false otherwise.
+  bool SaveToFile(const base::FilePath& path) const;
+
+ private:
+  // Protects the stages.
+  mutable base::Lock lock_;
+
+  // The statistics of the stages recorded so far.
+  StageStatsMap stages_;  // Under lock_.
+
+  DISALLOW_COPY_AND_ASSIGN(StageProfiler);
+};
+
+// Times a stage of a tool for as long as it's in scope, and records it in the
+// process-wide profiler.
+class ScopedStageTimer {
+ public:
+  // @param stage The name of the stage.
+  explicit ScopedStageTimer(const base::StringPiece& stage);
+  ~ScopedStageTimer();
+
+ private:
+  std::string stage_;
+  base::TimeTicks start_time_;
+  StageProfiler::MemoryUsage start_usage_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedStageTimer);
+};
+
+}  // namespace common
+
+#endif  // SYZYGY_COMMON_STAGE_PROFILER_H_
@@ -0,0 +1,127 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/common/stage_profiler.h"
+
+#include "base/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/json/json_reader.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/values.h"
+#include "gtest/gtest.h"
+
+namespace common {
+
+namespace {
+
+StageProfiler::MemoryUsage MakeUsage(size_t private_bytes) {
+  StageProfiler::MemoryUsage usage;
+  usage.peak_working_set = 2 * private_bytes;
+  usage.private_bytes = private_bytes;
+  return usage;
+}
+
+}  // namespace
+
+TEST(StageProfilerTest, RecordStage) {
+  StageProfiler profiler;
+  profiler.RecordStage("foo", base::TimeDelta::FromMilliseconds(10),
+                       MakeUsage(100), MakeUsage(300));
+  profiler.RecordStage("foo", base::TimeDelta::FromMilliseconds(30),
+                       MakeUsage(300), MakeUsage(200));
+  profiler.RecordStage("bar", base::TimeDelta::FromMilliseconds(5),
+                       MakeUsage(100), MakeUsage(150));
+
+  StageProfiler::StageStatsMap stages;
+  profiler.GetStages(&stages);
+  ASSERT_EQ(2U, stages.size());
+
+  const StageProfiler::StageStats& foo = stages["foo"];
+  EXPECT_EQ(2U, foo.count);
+  EXPECT_EQ(40, foo.total_time.InMilliseconds());
+  EXPECT_EQ(30, foo.max_time.InMilliseconds());
+  EXPECT_EQ(400U, foo.peak_working_set);
+  EXPECT_EQ(200U, foo.max_private_bytes_growth);
+
+  const StageProfiler::StageStats& bar = stages["bar"];
+  EXPECT_EQ(1U, bar.count);
+  EXPECT_EQ(5, bar.total_time.InMilliseconds());
+  EXPECT_EQ(50U, bar.max_private_bytes_growth);
+
+  profiler.Clear();
+  profiler.GetStages(&stages);
+  EXPECT_TRUE(stages.empty());
+}
+
+TEST(StageProfilerTest, GetMemoryUsage) {
+  StageProfiler::MemoryUsage usage;
+  ASSERT_TRUE(StageProfiler::GetMemoryUsage(&usage));
+  EXPECT_LT(0U, usage.peak_working_set);
+  EXPECT_LT(0U, usage.private_bytes);
+}
+
+TEST(StageProfilerTest, ScopedStageTimer) {
+  const char kStage[] = "StageProfilerTest.ScopedStageTimer";
+  StageProfiler::StageStatsMap stages;
+  StageProfiler::Instance()->GetStages(&stages);
+  EXPECT_EQ(0U, stages.count(kStage));
+
+  {
+    ScopedStageTimer timer(kStage);
+  }
+  {
+    ScopedStageTimer timer(kStage);
+  }
+
+  StageProfiler::Instance()->GetStages(&stages);
+  ASSERT_EQ(1U, stages.count(kStage));
+  EXPECT_EQ(2U, stages[kStage].count);
+  EXPECT_LT(0U, stages[kStage].peak_working_set);
+}
+
+TEST(StageProfilerTest, SaveToFile) {
+  StageProfiler profiler;
+  profiler.RecordStage("foo", base::TimeDelta::FromMilliseconds(10),
+                       MakeUsage(100), MakeUsage(300));
+
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath path = temp_dir.path().AppendASCII("profile.json");
+  ASSERT_TRUE(profiler.SaveToFile(path));
+
+  std::string contents;
+  ASSERT_TRUE(file_util::ReadFileToString(path, &contents));
+  scoped_ptr<base::Value> value(base::JSONReader::Read(contents));
+  ASSERT_TRUE(value.get() != NULL);
+
+  const base::DictionaryValue* profile = NULL;
+  ASSERT_TRUE(value->GetAsDictionary(&profile));
+  const base::DictionaryValue* foo = NULL;
+  ASSERT_TRUE(profile->GetDictionaryWithoutPathExpansion("foo", &foo));
+
+  int count = 0;
+  EXPECT_TRUE(foo->GetInteger("count", &count));
+  EXPECT_EQ(1, count);
+  double total_time_ms = 0;
+  EXPECT_TRUE(foo->GetDouble("total_time_ms", &total_time_ms));
+  EXPECT_EQ(10.0, total_time_ms);
+  int peak_working_set = 0;
+  EXPECT_TRUE(foo->GetInteger("peak_working_set", &peak_working_set));
+  EXPECT_EQ(600, peak_working_set);
+  int growth = 0;
+  EXPECT_TRUE(foo->GetInteger("max_private_bytes_growth", &growth));
+  EXPECT_EQ(200, growth);
+}
+
+}  // namespace common
@@ -19,6 +19,7 @@
 #define SYZYGY_CORE_ADDRESS_FILTER_H_
 
 #include "syzygy/core/address_space.h"
+#include "syzygy/core/flat_map.h"
 
 namespace core {
 
@@ -32,7 +33,9 @@ class AddressFilter {
   typedef SizeType Size;
   typedef AddressRange<AddressType, SizeType> Range;
   typedef AddressRangeLessThan<AddressType, SizeType> RangeLessThan;
-  typedef std::set<Range, RangeLessThan> RangeSet;
+  // The marked ranges are kept sorted and disjoint in contiguous storage, which
+  // keeps lookups cache friendly and lets the set operations be linear merges.
+  typedef FlatSet<Range, RangeLessThan> RangeSet;
 
   // Default constructor. This is only for compatibility with STL containers.
   AddressFilter() { }
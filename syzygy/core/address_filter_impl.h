@@ -82,12 +82,13 @@ void AddressFilter<AddressType, SizeType>::Mark(const Range& range) {
   AddressType search = r.start();
   if (extent_.start() < search && search - 1 < search)
     search = search - 1;
-  RangeSet::iterator it1 = marked_ranges_.lower_bound(Range(search, 1));
+  typename RangeSet::iterator it1 =
+      marked_ranges_.lower_bound(Range(search, 1));
 
   // If there is no such block, or it is completely past us (and not adjoining),
   // then we can cleanly insert our range.
   if (it1 == marked_ranges_.end() || r.end() < it1->start()) {
-    CHECK(marked_ranges_.insert(r).second);
+    marked_ranges_.insert(it1, r);
     return;
   }
 
@@ -99,30 +100,18 @@ void AddressFilter<AddressType, SizeType>::Mark(const Range& range) {
 
   // Now we want to find the rightmost range we intersect.
   AddressType end = r.end();
-  RangeSet::iterator it2 = it1;
-  RangeSet::iterator it2_prev = it2;
-  while (it2 != marked_ranges_.end() && end >= it2->start()) {
-    it2_prev = it2;
+  typename RangeSet::iterator it2 = it1;
+  while (it2 != marked_ranges_.end() && end >= it2->start())
     ++it2;
-  }
-  DCHECK(it2_prev != marked_ranges_.end());
+  DCHECK(it2 != it1);
 
   // Keep track of the rightmost point of any intervals we intersect.
-  if (it2_prev->end() > end)
-    end = it2_prev->end();
-
-  // Keep a hint so that we can do O(1) insertion.
-  RangeSet::iterator hint = marked_ranges_.end();
-  if (it1 != marked_ranges_.begin()) {
-    hint = it1;
-    --hint;
-  }
-
-  // Delete the conflicting intervals.
-  marked_ranges_.erase(it1, it2);
+  if ((it2 - 1)->end() > end)
+    end = (it2 - 1)->end();
 
-  // And insert the merged interval.
-  marked_ranges_.insert(hint, Range(start, end - start));
+  // Replace the conflicting intervals with the merged one.
+  *it1 = Range(start, end - start);
+  marked_ranges_.erase(it1 + 1, it2);
 }
 
 template<typename AddressType, typename SizeType>
@@ -133,7 +122,8 @@ void AddressFilter<AddressType, SizeType>::Unmark(const Range& range) {
 
   // Get the first range that is *not* less than the beginning of the range
   // to be inserted. Which means either it contains us, or it is past us.
-  RangeSet::iterator it1 = marked_ranges_.lower_bound(Range(r.start(), 1));
+  typename RangeSet::iterator it1 =
+      marked_ranges_.lower_bound(Range(r.start(), 1));
 
   // If there is no such block, or it is completely past us, then there is
   // nothing to remove.
@@ -148,38 +138,28 @@ void AddressFilter<AddressType, SizeType>::Unmark(const Range& range) {
 
   // Now we want to find the rightmost range we intersect.
   AddressType end = r.end();
-  RangeSet::iterator it2 = it1;
-  RangeSet::iterator it2_prev = it2;
-  while (it2 != marked_ranges_.end() && end >= it2->start()) {
-    it2_prev = it2;
+  typename RangeSet::iterator it2 = it1;
+  while (it2 != marked_ranges_.end() && end >= it2->start())
     ++it2;
-  }
-  DCHECK(it2_prev != marked_ranges_.end());
+  DCHECK(it2 != it1);
 
   // Keep track of the rightmost point of any intervals we intersect.
-  if (it2_prev->end() > end)
-    end = it2_prev->end();
-
-  // Keep a hint so that we can do O(1) insertion.
-  RangeSet::iterator hint = marked_ranges_.end();
-  if (it1 != marked_ranges_.begin()) {
-    hint = it1;
-    --hint;
-  }
+  if ((it2 - 1)->end() > end)
+    end = (it2 - 1)->end();
 
   // Delete the range of intersecting intervals.
-  marked_ranges_.erase(it1, it2);
+  typename RangeSet::iterator it = marked_ranges_.erase(it1, it2);
 
   // Reinsert the left tail if there is one.
   if (start < r.start()) {
     SizeType length = r.start() - start;
-    hint = marked_ranges_.insert(hint, Range(start, length));
+    it = marked_ranges_.insert(it, Range(start, length)) + 1;
   }
 
   // Reinsert the right tail if there is one.
   if (end > r.end()) {
     SizeType length = end - r.end();
-    hint = marked_ranges_.insert(hint, Range(r.end(), length));
+    marked_ranges_.insert(it, Range(r.end(), length));
   }
 }
 
@@ -193,7 +173,8 @@ bool AddressFilter<AddressType, SizeType>::IsMarked(const Range& range) const {
 
   // Get the first r that is *not* less than the beginning of the range
   // to be inserted. Which means either it contains us, or it is past us.
-  RangeSet::iterator it = marked_ranges_.lower_bound(Range(r.start(), 1));
+  typename RangeSet::const_iterator it =
+      marked_ranges_.lower_bound(Range(r.start(), 1));
 
   // If there is no such block, or it is completely past us, then our range
   // is not marked.
@@ -217,7 +198,7 @@ bool AddressFilter<AddressType, SizeType>::IsUnmarked(
 
   // Get the first range that is *not* less than the beginning of the range
   // to be inserted. Which means either it contains us, or it is past us.
-  RangeSet::iterator it = marked_ranges_.lower_bound(
+  typename RangeSet::const_iterator it = marked_ranges_.lower_bound(
       Range(r.start(), 1));
 
   // If there is no such block then we are not marked.
@@ -229,41 +210,33 @@ bool AddressFilter<AddressType, SizeType>::IsUnmarked(
   return !r.Intersects(*it);
 }
 
+// The set operations all walk the sorted ranges of their operands in a single
+// pass, appending the ranges of the result in increasing order. They work
+// with a temporary RangeSet and swap its contents later, handling the case
+// when 'filter == this'.
+
 template<typename AddressType, typename SizeType>
 void AddressFilter<AddressType, SizeType>::Invert(AddressFilter* filter) const {
   DCHECK(filter != NULL);
 
-  // We work with a temporary RangeSet and swap its contents later, handling
-  // the case when 'filter == this'.
-  filter->extent_ = extent_;
   RangeSet ranges;
+  ranges.reserve(marked_ranges_.size() + 1);
 
-  RangeSet::const_iterator it = marked_ranges_.begin();
   AddressType cursor = extent_.start();
-
-  // Special case: The filter is empty.
-  if (it == marked_ranges_.end()) {
-    CHECK(filter->marked_ranges_.insert(extent_).second);
-    return;
-  }
-
-  RangeSet::iterator hint = ranges.end();
-
-  if (cursor < it->start())
-    hint = ranges.insert(hint, Range(cursor, it->start() - cursor));
-  cursor = it->end();
-  ++it;
-
+  typename RangeSet::const_iterator it = marked_ranges_.begin();
   for (; it != marked_ranges_.end(); ++it) {
-    // The ranges must be discontiguous so this is always true.
-    DCHECK_LT(cursor, it->start());
-    hint = ranges.insert(hint, Range(cursor, it->start() - cursor));
+    // The ranges must be discontiguous so this is always true, except maybe
+    // for the first range.
+    DCHECK(cursor < it->start() || it == marked_ranges_.begin());
+    if (cursor < it->start())
+      ranges.insert(ranges.end(), Range(cursor, it->start() - cursor));
     cursor = it->end();
   }
 
   if (cursor < extent_.end())
-    ranges.insert(hint, Range(cursor, extent_.end() - cursor));
+    ranges.insert(ranges.end(), Range(cursor, extent_.end() - cursor));
 
+  filter->extent_ = extent_;
   filter->marked_ranges_.swap(ranges);
 }
 
@@ -272,12 +245,6 @@ void AddressFilter<AddressType, SizeType>::Intersect(
     const AddressFilter& other, AddressFilter* filter) const {
   DCHECK(filter != NULL);
 
-  // By our definition the result has the same extent as |this|. This is
-  // somewhat arbitrary.
-  filter->extent_ = extent_;
-
-  // We work with a temporary RangeSet and swap its contents later, handling
-  // the case when 'filter == this'.
   RangeSet ranges;
 
   // We only need to iterate over those ranges that are in the intersection of
@@ -285,17 +252,16 @@ void AddressFilter<AddressType, SizeType>::Intersect(
   Range extent;
   internal::Intersect(extent_, other.extent_, &extent);
 
-  RangeSet::const_iterator it1 = marked_ranges_.lower_bound(
+  typename RangeSet::const_iterator it1 = marked_ranges_.lower_bound(
       Range(extent.start(), 1));
-  RangeSet::const_iterator it1_end = marked_ranges_.lower_bound(
+  typename RangeSet::const_iterator it1_end = marked_ranges_.lower_bound(
       Range(extent.end(), 1));
 
-  RangeSet::const_iterator it2 = other.marked_ranges_.lower_bound(
+  typename RangeSet::const_iterator it2 = other.marked_ranges_.lower_bound(
       Range(extent.start(), 1));
-  RangeSet::const_iterator it2_end = other.marked_ranges_.lower_bound(
+  typename RangeSet::const_iterator it2_end = other.marked_ranges_.lower_bound(
       Range(extent.end(), 1));
 
-  RangeSet::iterator hint = ranges.end();
   while (it1 != it1_end && it2 != it2_end) {
     // Calculate the intersection. If it is empty this returns information
     // regarding the relative ordering of the two intervals in question.
@@ -312,7 +278,7 @@ void AddressFilter<AddressType, SizeType>::Intersect(
       case 0: {
         // We have intersecting intervals, so add their intersection to the
         // output.
-        hint = ranges.insert(hint, range);
+        ranges.insert(ranges.end(), range);
 
         // Advance the iterator with the lesser interval endpoint, or both of
         // them if they are equal.
@@ -335,37 +301,60 @@ void AddressFilter<AddressType, SizeType>::Intersect(
     }
   }
 
+  // By our definition the result has the same extent as |this|. This is
+  // somewhat arbitrary.
+  filter->extent_ = extent_;
   filter->marked_ranges_.swap(ranges);
 }
 
-// NOTE: The following are implemented using a lazy O(n log n) approach, when
-//     they could be O(n). The code would be significantly more complicated and
-//     for the limited use we will make of these things it's simply not worth
-//     the effort.
-
 template<typename AddressType, typename SizeType>
 void AddressFilter<AddressType, SizeType>::Union(
     const AddressFilter& other, AddressFilter* filter) const {
   DCHECK(filter != NULL);
 
-  // We work with a temporary AddressFilter and swap its contents later,
-  // handling the case when 'filter == this'.
-  filter->extent_ = extent_;
-  AddressFilter temp(*this);
+  RangeSet ranges;
+  ranges.reserve(marked_ranges_.size() + other.marked_ranges_.size());
 
-  // We only need to iterate over those ranges that are in the intersection of
-  // the extents of the two filters.
+  // We only need to iterate over those ranges of |other| that are in the
+  // intersection of the extents of the two filters.
   Range extent;
   internal::Intersect(extent_, other.extent_, &extent);
-  RangeSet::const_iterator it = other.marked_ranges_.lower_bound(
+  typename RangeSet::const_iterator it1 = marked_ranges_.begin();
+  typename RangeSet::const_iterator it2 = other.marked_ranges_.lower_bound(
       Range(extent.start(), 1));
-  RangeSet::const_iterator it_end = other.marked_ranges_.lower_bound(
+  typename RangeSet::const_iterator it2_end = other.marked_ranges_.lower_bound(
       Range(extent.end(), 1));
 
-  for (; it != it_end; ++it)
-    temp.Mark(*it);
+  // Merge the two sequences of ranges by their starting points, coalescing
+  // the ranges which overlap or touch.
+  while (it1 != marked_ranges_.end() || it2 != it2_end) {
+    Range range;
+    if (it2 == it2_end ||
+        (it1 != marked_ranges_.end() && it1->start() < it2->start())) {
+      range = *it1;
+      ++it1;
+    } else {
+      // The ranges of |other| may straddle our extent.
+      bool intersects = internal::Intersect(extent_, *it2, &range);
+      ++it2;
+      if (!intersects)
+        continue;
+    }
+
+    if (!ranges.empty()) {
+      typename RangeSet::iterator last = ranges.end() - 1;
+      if (range.start() <= last->end()) {
+        if (range.end() > last->end())
+          *last = Range(last->start(), range.end() - last->start());
+        continue;
+      }
+    }
+    ranges.insert(ranges.end(), range);
+  }
 
-  filter->marked_ranges_.swap(temp.marked_ranges_);
+  // By our definition the result has the same extent as |this|.
+  filter->extent_ = extent_;
+  filter->marked_ranges_.swap(ranges);
 }
 
 template<typename AddressType, typename SizeType>
@@ -373,24 +362,36 @@ void AddressFilter<AddressType, SizeType>::Subtract(
     const AddressFilter& other, AddressFilter* filter) const {
   DCHECK(filter != NULL);
 
-  // We work with a temporary AddressFilter and swap its contents later,
-  // handling the case when 'filter == this'.
-  filter->extent_ = extent_;
-  AddressFilter temp(*this);
-
-  // We only need to iterate over those ranges that are in the intersection of
-  // the extents of the two filters.
-  Range extent;
-  internal::Intersect(extent_, other.extent_, &extent);
-  RangeSet::const_iterator it = other.marked_ranges_.lower_bound(
-      Range(extent.start(), 1));
-  RangeSet::const_iterator it_end = other.marked_ranges_.lower_bound(
-      Range(extent.end(), 1));
+  RangeSet ranges;
+  ranges.reserve(marked_ranges_.size());
+
+  typename RangeSet::const_iterator it2 = other.marked_ranges_.begin();
+  typename RangeSet::const_iterator it1 = marked_ranges_.begin();
+  for (; it1 != marked_ranges_.end(); ++it1) {
+    // Skip the ranges of |other| that lie entirely before this one.
+    AddressType cursor = it1->start();
+    while (it2 != other.marked_ranges_.end() && it2->end() <= cursor)
+      ++it2;
+
+    // Carve out the ranges of |other| that overlap this one. The last of them
+    // may also overlap the next range, so it isn't skipped.
+    for (; it2 != other.marked_ranges_.end() && it2->start() < it1->end();
+         ++it2) {
+      if (cursor < it2->start())
+        ranges.insert(ranges.end(), Range(cursor, it2->start() - cursor));
+      if (cursor < it2->end())
+        cursor = it2->end();
+      if (it2->end() > it1->end())
+        break;
+    }
 
-  for (; it != it_end; ++it)
-    temp.Unmark(*it);
+    if (cursor < it1->end())
+      ranges.insert(ranges.end(), Range(cursor, it1->end() - cursor));
+  }
 
-  filter->marked_ranges_.swap(temp.marked_ranges_);
+  // By our definition the result has the same extent as |this|.
+  filter->extent_ = extent_;
+  filter->marked_ranges_.swap(ranges);
 }
 
 }  // namespace core
@@ -945,4 +945,53 @@ TEST(AddressFilterTest, Difference) {
   }
 }
 
+TEST(AddressFilterTest, InvertEmptyIntoNonEmpty) {
+  TestAddressFilter f1(MakeRange(0, 100));
+  TestAddressFilter f2(MakeRange(0, 100));
+  f2.Mark(MakeRange(10, 10));
+
+  // Inverting an empty filter marks its whole extent, replacing whatever the
+  // output filter contained.
+  f1.Invert(&f2);
+  RangeSet expected;
+  expected.insert(MakeRange(0, 100));
+  EXPECT_THAT(expected, ContainerEq(f2.marked_ranges()));
+}
+
+TEST(AddressFilterTest, SetOperationsMatchBitmap) {
+  const size_t kSize = 400;
+  TestAddressFilter f1(MakeRange(0, kSize));
+  TestAddressFilter f2(MakeRange(0, kSize));
+  std::vector<bool> bits1(kSize, false);
+  std::vector<bool> bits2(kSize, false);
+
+  // Mark interleaved ranges of varying lengths in both filters, some of them
+  // adjoining.
+  for (size_t i = 0; i + 7 < kSize; i += 11) {
+    f1.Mark(MakeRange(i, 5));
+    std::fill(bits1.begin() + i, bits1.begin() + i + 5, true);
+    f2.Mark(MakeRange(i + 3, 4 + i % 3));
+    std::fill(bits2.begin() + i + 3, bits2.begin() + i + 7 + i % 3, true);
+  }
+
+  TestAddressFilter u;
+  f1.Union(f2, &u);
+  TestAddressFilter s;
+  f1.Subtract(f2, &s);
+  TestAddressFilter n;
+  f1.Intersect(f2, &n);
+
+  for (size_t i = 0; i < kSize; ++i) {
+    Range r(MakeRange(i, 1));
+    EXPECT_EQ(bits1[i] || bits2[i], u.IsMarked(r));
+    EXPECT_EQ(bits1[i] && !bits2[i], s.IsMarked(r));
+    EXPECT_EQ(bits1[i] && bits2[i], n.IsMarked(r));
+  }
+
+  // The results must consist of disjoint, non-adjoining ranges.
+  RangeSet::const_iterator it = u.marked_ranges().begin();
+  for (; it + 1 < u.marked_ranges().end(); ++it)
+    EXPECT_LT(it->end(), (it + 1)->start());
+}
+
 }  // namespace core
@@ -31,6 +31,7 @@
 
 #include "base/logging.h"
 #include "syzygy/core/address_space_internal.h"
+#include "syzygy/core/flat_map.h"
 #include "syzygy/core/serialization.h"
 
 namespace core {
@@ -40,14 +41,25 @@ template <typename AddressType, typename SizeType> class AddressRange;
 
 // An address space is a mapping from a set of non-overlapping address ranges
 // (AddressSpace::Range), each of non-zero size, to an ItemType.
-template <typename AddressType, typename SizeType, typename ItemType>
+//
+// The ranges are stored in a RangeMapType, which defaults to a std::map. For
+// address spaces that are populated once and then searched intensively,
+// core::FlatMap<Range, ItemType> may be used instead. It stores the ranges in
+// a sorted array, making FindFirstIntersection, FindContaining and friends
+// considerably more cache friendly. Insertion and removal are then O(N),
+// however, and invalidate all iterators into the address space.
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType =
+              std::map<AddressRange<AddressType, SizeType>, ItemType> >
 class AddressSpace {
  public:
   // Typedef we use for convenience throughout.
   typedef AddressRange<AddressType, SizeType> Range;
-  typedef std::map<Range, ItemType> RangeMap;
-  typedef typename std::map<Range, ItemType>::iterator RangeMapIter;
-  typedef typename std::map<Range, ItemType>::const_iterator RangeMapConstIter;
+  typedef RangeMapType RangeMap;
+  typedef typename RangeMap::iterator RangeMapIter;
+  typedef typename RangeMap::const_iterator RangeMapConstIter;
   typedef std::pair<RangeMapConstIter, RangeMapConstIter> RangeMapConstIterPair;
   typedef std::pair<RangeMapIter, RangeMapIter> RangeMapIterPair;
 
@@ -471,12 +483,14 @@ class AddressRangeMap {
   RangePairs range_pairs_;
 };
 
-template <typename AddressType, typename SizeType, typename ItemType>
-AddressSpace<AddressType, SizeType, ItemType>::AddressSpace() {
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::AddressSpace() {
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::Insert(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::Insert(
     const Range& range,
     const ItemType& item,
     typename RangeMap::iterator* ret_it) {
@@ -494,8 +508,9 @@ bool AddressSpace<AddressType, SizeType, ItemType>::Insert(
   return true;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::FindOrInsert(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindOrInsert(
     const Range& range,
     const ItemType& item,
     typename RangeMap::iterator* ret_it) {
@@ -517,8 +532,9 @@ bool AddressSpace<AddressType, SizeType, ItemType>::FindOrInsert(
   return true;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::SubsumeInsert(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::SubsumeInsert(
     const Range& range,
     const ItemType& item,
     typename RangeMap::iterator* ret_it) {
@@ -569,8 +585,9 @@ bool AddressSpace<AddressType, SizeType, ItemType>::SubsumeInsert(
   return true;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-void AddressSpace<AddressType, SizeType, ItemType>::MergeInsert(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+void AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::MergeInsert(
     const Range& range,
     const ItemType& item,
     typename RangeMap::iterator* ret_it) {
@@ -610,8 +627,10 @@ void AddressSpace<AddressType, SizeType, ItemType>::MergeInsert(
   return;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::Remove(const Range& range) {
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::Remove(
+    const Range& range) {
   RangeMap::iterator it = ranges_.find(range);
   if (it == ranges_.end())
     return false;
@@ -620,17 +639,21 @@ bool AddressSpace<AddressType, SizeType, ItemType>::Remove(const Range& range) {
   return true;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMap::const_iterator
-AddressSpace<AddressType, SizeType, ItemType>::FindFirstIntersection(
-    const Range& range) const {
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMap::const_iterator
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::
+    FindFirstIntersection(const Range& range) const {
   return const_cast<AddressSpace*>(this)->FindFirstIntersection(range);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMap::iterator
-AddressSpace<AddressType, SizeType, ItemType>::FindFirstIntersection(
-    const Range& range) {
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMap::iterator
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::
+    FindFirstIntersection(const Range& range) {
   RangeMap::iterator it(ranges_.lower_bound(range));
 
   // There are three cases we need to handle here:
@@ -655,16 +678,20 @@ AddressSpace<AddressType, SizeType, ItemType>::FindFirstIntersection(
   return ranges_.end();
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMapConstIterPair
-AddressSpace<AddressType, SizeType, ItemType>::FindIntersecting(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMapConstIterPair
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindIntersecting(
     const Range& range) const {
   return const_cast<AddressSpace*>(this)->FindIntersecting(range);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMapIterPair
-AddressSpace<AddressType, SizeType, ItemType>::FindIntersecting(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMapIterPair
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindIntersecting(
     const Range& range) {
   // Find the start of the range first.
   RangeMap::iterator begin(FindFirstIntersection(range));
@@ -688,15 +715,18 @@ AddressSpace<AddressType, SizeType, ItemType>::FindIntersecting(
   return std::make_pair(begin, end);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::Intersects(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::Intersects(
     const Range& range) const {
   RangeMapConstIterPair its = FindIntersecting(range);
   return (its.first != its.second);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::ContainsExactly(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::
+    ContainsExactly(
     const Range& range) const {
   RangeMapConstIterPair its = FindIntersecting(range);
   if (its.first == its.second)
@@ -704,8 +734,9 @@ bool AddressSpace<AddressType, SizeType, ItemType>::ContainsExactly(
   return its.first->first == range;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::Contains(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::Contains(
     const Range& range) const {
   RangeMapConstIterPair its = FindIntersecting(range);
   if (its.first == its.second)
@@ -713,9 +744,11 @@ bool AddressSpace<AddressType, SizeType, ItemType>::Contains(
   return its.first->first.Contains(range);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMap::const_iterator
-AddressSpace<AddressType, SizeType, ItemType>::FindContaining(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMap::const_iterator
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindContaining(
     const Range& range) const {
   // If there is a containing range, it must be the first intersection.
   RangeMap::const_iterator it(FindFirstIntersection(range));
@@ -725,9 +758,11 @@ AddressSpace<AddressType, SizeType, ItemType>::FindContaining(
   return ranges_.end();
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMap::iterator
-AddressSpace<AddressType, SizeType, ItemType>::FindContaining(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMap::iterator
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindContaining(
     const Range& range) {
   // If there is a containing range, it must be the first intersection.
   RangeMap::iterator it(FindFirstIntersection(range));
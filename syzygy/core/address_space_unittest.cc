@@ -17,6 +17,7 @@
 #include <limits>
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "syzygy/core/random_number_generator.h"
 #include "syzygy/core/unittest_util.h"
 
 namespace core {
@@ -415,6 +416,95 @@ TEST(AddressSpaceTest, FindIntersecting) {
   EXPECT_EQ(120, it_pair.second->first.start());
 }
 
+typedef AddressSpace<size_t, size_t, void*,
+                     FlatMap<IntegerRange, void*> > FlatIntegerAddressSpace;
+
+TEST(FlatAddressSpaceTest, InsertAndFind) {
+  FlatIntegerAddressSpace address_space;
+  void* item = "Something to point at";
+
+  // Insert out of order to exercise the sorted insertion.
+  EXPECT_TRUE(address_space.Insert(IntegerRange(120, 10), item));
+  EXPECT_TRUE(address_space.Insert(IntegerRange(100, 10), item));
+  EXPECT_TRUE(address_space.Insert(IntegerRange(110, 5), item));
+  EXPECT_FALSE(address_space.Insert(IntegerRange(105, 10), item));
+  EXPECT_EQ(3u, address_space.size());
+
+  FlatIntegerAddressSpace::RangeMapConstIter it =
+      address_space.FindFirstIntersection(IntegerRange(105, 30));
+  ASSERT_TRUE(it != address_space.end());
+  EXPECT_EQ(100, it->first.start());
+
+  it = address_space.FindContaining(IntegerRange(113, 2));
+  ASSERT_TRUE(it != address_space.end());
+  EXPECT_EQ(110, it->first.start());
+  EXPECT_TRUE(address_space.FindContaining(IntegerRange(109, 5)) ==
+      address_space.end());
+
+  FlatIntegerAddressSpace::RangeMapConstIterPair it_pair =
+      address_space.FindIntersecting(IntegerRange(100, 15));
+  ASSERT_TRUE(it_pair.first != address_space.end());
+  ASSERT_TRUE(it_pair.second != address_space.end());
+  EXPECT_EQ(100, it_pair.first->first.start());
+  EXPECT_EQ(120, it_pair.second->first.start());
+
+  EXPECT_TRUE(address_space.Remove(IntegerRange(110, 5)));
+  EXPECT_FALSE(address_space.Contains(110, 5));
+  EXPECT_EQ(2u, address_space.size());
+}
+
+TEST(FlatAddressSpaceTest, SubsumeAndMergeInsert) {
+  FlatIntegerAddressSpace address_space;
+  void* item = "Something to point at";
+
+  EXPECT_TRUE(address_space.Insert(IntegerRange(100, 10), item));
+  EXPECT_TRUE(address_space.Insert(IntegerRange(120, 10), item));
+  EXPECT_TRUE(address_space.SubsumeInsert(IntegerRange(95, 40), item));
+  EXPECT_EQ(1u, address_space.size());
+  EXPECT_TRUE(address_space.ContainsExactly(95, 40));
+
+  EXPECT_TRUE(address_space.Insert(IntegerRange(140, 10), item));
+  address_space.MergeInsert(IntegerRange(130, 12), item);
+  EXPECT_EQ(1u, address_space.size());
+  EXPECT_TRUE(address_space.ContainsExactly(95, 55));
+}
+
+TEST(FlatAddressSpaceTest, BehavesLikeMapBackedAddressSpace) {
+  RandomNumberGenerator rng(0xF1A7);
+  IntegerAddressSpace map_space;
+  FlatIntegerAddressSpace flat_space;
+  void* item = "Something to point at";
+
+  for (size_t i = 0; i < 2000; ++i) {
+    IntegerRange range(rng(1000), rng(20) + 1);
+    switch (rng(3)) {
+      case 0:
+        ASSERT_EQ(map_space.Insert(range, item),
+                  flat_space.Insert(range, item));
+        break;
+
+      case 1:
+        ASSERT_EQ(map_space.SubsumeInsert(range, item),
+                  flat_space.SubsumeInsert(range, item));
+        break;
+
+      case 2:
+        ASSERT_EQ(map_space.Remove(range), flat_space.Remove(range));
+        break;
+    }
+
+    ASSERT_EQ(map_space.size(), flat_space.size());
+    IntegerAddressSpace::const_iterator map_it = map_space.begin();
+    FlatIntegerAddressSpace::const_iterator flat_it = flat_space.begin();
+    for (; map_it != map_space.end(); ++map_it, ++flat_it)
+      ASSERT_EQ(map_it->first, flat_it->first);
+
+    IntegerRange query(rng(1000), rng(20) + 1);
+    ASSERT_EQ(map_space.Intersects(query), flat_space.Intersects(query));
+    ASSERT_EQ(map_space.Contains(query), flat_space.Contains(query));
+  }
+}
+
 TEST(AddressRangeMapTest, IsSimple) {
   IntegerRangeMap map;
   EXPECT_FALSE(map.IsSimple());
@@ -0,0 +1,70 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/arena.h"
+
+#include "base/logging.h"
+
+namespace core {
+
+Arena::Arena()
+    : chunk_size_(kDefaultChunkSize), cursor_(NULL), end_(NULL),
+      allocated_size_(0), reserved_size_(0) {
+}
+
+Arena::Arena(size_t chunk_size)
+    : chunk_size_(chunk_size), cursor_(NULL), end_(NULL), allocated_size_(0),
+      reserved_size_(0) {
+  DCHECK_LT(0u, chunk_size);
+}
+
+Arena::~Arena() {
+  for (size_t i = 0; i < chunks_.size(); ++i)
+    delete [] chunks_[i];
+}
+
+void* Arena::Allocate(size_t size) {
+  COMPILE_ASSERT((kAlignment & (kAlignment - 1)) == 0,
+                 arena_alignment_must_be_a_power_of_two);
+  size_t aligned_size = (size + kAlignment - 1) & ~(kAlignment - 1);
+  if (aligned_size == 0)
+    aligned_size = kAlignment;
+  allocated_size_ += aligned_size;
+
+  if (aligned_size <= static_cast<size_t>(end_ - cursor_)) {
+    void* block = cursor_;
+    cursor_ += aligned_size;
+    return block;
+  }
+
+  // Large requests get a chunk of their own, leaving the current chunk to
+  // serve the following requests.
+  if (aligned_size > chunk_size_ / 4) {
+    // Memory from operator new is suitably aligned for any type.
+    uint8* chunk = new uint8[aligned_size];
+    chunks_.push_back(chunk);
+    reserved_size_ += aligned_size;
+    return chunk;
+  }
+
+  // Start a new chunk. The tail of the current one is wasted.
+  uint8* chunk = new uint8[chunk_size_];
+  chunks_.push_back(chunk);
+  reserved_size_ += chunk_size_;
+  cursor_ = chunk + aligned_size;
+  end_ = chunk + chunk_size_;
+  return chunk;
+}
+
+}  // namespace core
@@ -0,0 +1,93 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares Arena, a bump-pointer allocator for objects that share a lifetime.
+// Memory is carved out of large chunks and released all at once when the
+// arena is destroyed, rather than object by object.
+//
+// Example use is as follows:
+//
+//   Arena arena;
+//   Foo* foo = new(arena.Allocate(sizeof(Foo))) Foo();
+//   ...
+//   foo->~Foo();
+//
+// The arena doesn't run destructors; objects owning other resources must be
+// destroyed explicitly before the arena goes away.
+
+#ifndef SYZYGY_CORE_ARENA_H_
+#define SYZYGY_CORE_ARENA_H_
+
+#include <vector>
+
+#include "base/basictypes.h"
+
+namespace core {
+
+class Arena {
+ public:
+  // The alignment of every allocation.
+  static const size_t kAlignment = 8;
+  // The default size of the chunks memory is carved from.
+  static const size_t kDefaultChunkSize = 64 * 1024;
+
+  // Creates an arena using chunks of kDefaultChunkSize bytes.
+  Arena();
+
+  // Creates an arena using chunks of @p chunk_size bytes.
+  // @param chunk_size the size of the chunks memory is carved from.
+  explicit Arena(size_t chunk_size);
+
+  // Releases all of the memory handed out by the arena.
+  ~Arena();
+
+  // Allocates a block of memory. Requests larger than a quarter of a chunk
+  // get a dedicated chunk, so as to not waste the tail of the current one.
+  // @param size the size of the block, in bytes.
+  // @returns a block of @p size bytes aligned to kAlignment. This never
+  //     returns NULL.
+  void* Allocate(size_t size);
+
+  // @returns the total number of bytes handed out by the arena.
+  size_t allocated_size() const { return allocated_size_; }
+
+  // @returns the number of chunks the arena has allocated.
+  size_t chunk_count() const { return chunks_.size(); }
+
+  // @returns the total size of the chunks the arena has allocated, in bytes.
+  size_t reserved_size() const { return reserved_size_; }
+
+ private:
+  // The size of the regular chunks.
+  size_t chunk_size_;
+
+  // The chunks allocated so far.
+  std::vector<uint8*> chunks_;
+
+  // The free space of the current chunk.
+  uint8* cursor_;
+  uint8* end_;
+
+  // The total number of bytes handed out.
+  size_t allocated_size_;
+
+  // The total size of the chunks.
+  size_t reserved_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(Arena);
+};
+
+}  // namespace core
+
+#endif  // SYZYGY_CORE_ARENA_H_
@@ -0,0 +1,73 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/arena.h"
+
+#include <string.h>
+
+#include "gtest/gtest.h"
+
+namespace core {
+
+TEST(ArenaTest, DefaultConstructor) {
+  Arena arena;
+  EXPECT_EQ(0u, arena.allocated_size());
+  EXPECT_EQ(0u, arena.chunk_count());
+  EXPECT_EQ(0u, arena.reserved_size());
+}
+
+TEST(ArenaTest, AllocationsAreAlignedAndDisjoint) {
+  Arena arena(1024);
+
+  std::vector<uint8*> blocks;
+  for (size_t i = 0; i < 100; ++i) {
+    uint8* block = reinterpret_cast<uint8*>(arena.Allocate(i % 13));
+    ASSERT_TRUE(block != NULL);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(block) % Arena::kAlignment);
+    ::memset(block, static_cast<int>(i), i % 13);
+    blocks.push_back(block);
+  }
+
+  // No allocation should have overwritten another one.
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    for (size_t j = 0; j < i % 13; ++j)
+      EXPECT_EQ(i, blocks[i][j]);
+  }
+
+  // Several chunks must have been used, with most allocations sharing one.
+  EXPECT_LT(1u, arena.chunk_count());
+  EXPECT_GT(blocks.size() / 4, arena.chunk_count());
+}
+
+TEST(ArenaTest, LargeAllocationsGetTheirOwnChunk) {
+  Arena arena(1024);
+
+  void* small1 = arena.Allocate(16);
+  EXPECT_EQ(1u, arena.chunk_count());
+
+  void* large = arena.Allocate(2048);
+  ASSERT_TRUE(large != NULL);
+  ::memset(large, 0xAB, 2048);
+  EXPECT_EQ(2u, arena.chunk_count());
+
+  // The current chunk keeps serving small requests.
+  void* small2 = arena.Allocate(16);
+  EXPECT_EQ(2u, arena.chunk_count());
+  EXPECT_EQ(reinterpret_cast<uint8*>(small1) + 16, small2);
+
+  EXPECT_EQ(16u + 2048u + 16u, arena.allocated_size());
+  EXPECT_EQ(1024u + 2048u, arena.reserved_size());
+}
+
+}  // namespace core
@@ -0,0 +1,56 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares ClosureDelegate, a thread pool work item that runs a closure. This
+// lets a base::DelegateSimpleThreadPool be fed with bound callbacks:
+//
+//   base::DelegateSimpleThreadPool pool("Workers", num_threads);
+//   ScopedVector<core::ClosureDelegate> work;
+//   for (size_t i = 0; i < shards.size(); ++i) {
+//     work.push_back(new core::ClosureDelegate(
+//         base::Bind(&ProcessShard, &shards[i])));
+//     pool.AddWork(work.back());
+//   }
+//   pool.Start();
+//   pool.JoinAll();
+
+#ifndef SYZYGY_CORE_CLOSURE_DELEGATE_H_
+#define SYZYGY_CORE_CLOSURE_DELEGATE_H_
+
+#include "base/callback.h"
+#include "base/threading/simple_thread.h"
+
+namespace core {
+
+// A simple thread pool work item that runs a closure.
+class ClosureDelegate : public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param closure the closure to run. It is run once each time the delegate
+  //     is run.
+  explicit ClosureDelegate(const base::Closure& closure) : closure_(closure) {
+  }
+
+  virtual void Run() OVERRIDE {
+    closure_.Run();
+  }
+
+ private:
+  base::Closure closure_;
+
+  DISALLOW_COPY_AND_ASSIGN(ClosureDelegate);
+};
+
+}  // namespace core
+
+#endif  // SYZYGY_CORE_CLOSURE_DELEGATE_H_
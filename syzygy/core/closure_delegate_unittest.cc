@@ -0,0 +1,59 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/closure_delegate.h"
+
+#include <vector>
+
+#include "base/bind.h"
+#include "base/memory/scoped_vector.h"
+#include "gtest/gtest.h"
+
+namespace core {
+
+namespace {
+
+void Increment(size_t* value) {
+  ++(*value);
+}
+
+}  // namespace
+
+TEST(ClosureDelegateTest, RunInvokesClosure) {
+  size_t value = 0;
+  ClosureDelegate delegate(base::Bind(&Increment, &value));
+  delegate.Run();
+  EXPECT_EQ(1U, value);
+  delegate.Run();
+  EXPECT_EQ(2U, value);
+}
+
+TEST(ClosureDelegateTest, RunsOnThreadPool) {
+  static const size_t kNumItems = 16;
+  std::vector<size_t> values(kNumItems, 0);
+
+  base::DelegateSimpleThreadPool pool("ClosureDelegateTest", 4);
+  ScopedVector<ClosureDelegate> work;
+  for (size_t i = 0; i < kNumItems; ++i) {
+    work.push_back(new ClosureDelegate(base::Bind(&Increment, &values[i])));
+    pool.AddWork(work.back());
+  }
+  pool.Start();
+  pool.JoinAll();
+
+  for (size_t i = 0; i < kNumItems; ++i)
+    EXPECT_EQ(1U, values[i]);
+}
+
+}  // namespace core
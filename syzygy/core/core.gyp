@@ -28,14 +28,19 @@
         'address_space.cc',
         'address_space.h',
         'address_space_internal.h',
+        'arena.cc',
+        'arena.h',
         'assembler.cc',
         'assembler.h',
+        'closure_delegate.h',
         'disassembler.cc',
         'disassembler.h',
         'disassembler_util.cc',
         'disassembler_util.h',
+        'dense_id_map.h',
         'file_util.cc',
         'file_util.h',
+        'flat_map.h',
         'json_file_writer.cc',
         'json_file_writer.h',
         'random_number_generator.cc',
@@ -78,12 +83,16 @@
         'address_unittest.cc',
         'address_filter_unittest.cc',
         'address_space_unittest.cc',
+        'arena_unittest.cc',
         'core_unittests_main.cc',
         'assembler_unittest.cc',
+        'closure_delegate_unittest.cc',
         'disassembler_test_code.asm',
         'disassembler_unittest.cc',
+        'dense_id_map_unittest.cc',
         'disassembler_util_unittest.cc',
         'file_util_unittest.cc',
+        'flat_map_unittest.cc',
         'json_file_writer_unittest.cc',
         'register_unittest.cc',
         'serialization_unittest.cc',
@@ -0,0 +1,327 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares DenseIdMap, an implementation of the subset of the std::map
+// interface used throughout Syzygy for maps keyed by small, densely allocated
+// integer IDs. The values are stored in fixed-size chunks indexed directly by
+// their key, which makes lookups O(1) and iteration a sequential sweep rather
+// than a tree traversal.
+//
+// As with std::map, the values never move: insertions don't invalidate any
+// iterator or reference, and erasures only invalidate those to the erased
+// value. Erased values leave a tombstone behind, so the memory of the chunks
+// is only released by clear() or the destructor. Iteration is in increasing
+// key order.
+//
+// Keys must be non-negative, and the container's footprint is proportional to
+// the largest key it has held, so it's only suitable for IDs handed out
+// sequentially.
+
+#ifndef SYZYGY_CORE_DENSE_ID_MAP_H_
+#define SYZYGY_CORE_DENSE_ID_MAP_H_
+
+#include <iterator>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/logging.h"
+
+namespace core {
+
+// Forward declaration.
+template<typename Key, typename T, size_t kChunkSize = 1024> class DenseIdMap;
+
+namespace internal {
+
+// The bidirectional iterator of a DenseIdMap. This simply holds the index of
+// the value it points to, and skips over the empty slots.
+// @tparam Map the type of the iterated map, possibly const.
+// @tparam Value the type of the iterated values, possibly const.
+template<typename Map, typename Value>
+class DenseIdMapIterator
+    : public std::iterator<std::bidirectional_iterator_tag, Value> {
+ public:
+  DenseIdMapIterator() : map_(NULL), index_(Map::kEndIndex) {
+  }
+
+  DenseIdMapIterator(Map* map, size_t index) : map_(map), index_(index) {
+  }
+
+  // Allows converting an iterator to a const_iterator.
+  template<typename OtherMap, typename OtherValue>
+  DenseIdMapIterator(const DenseIdMapIterator<OtherMap, OtherValue>& other)
+      : map_(other.map_), index_(other.index_) {
+  }
+
+  Value& operator*() const {
+    DCHECK(map_ != NULL);
+    return *map_->GetSlot(index_);
+  }
+
+  Value* operator->() const {
+    DCHECK(map_ != NULL);
+    return map_->GetSlot(index_);
+  }
+
+  DenseIdMapIterator& operator++() {
+    DCHECK(map_ != NULL);
+    DCHECK_NE(Map::kEndIndex, index_);
+    index_ = map_->NextIndex(index_ + 1);
+    return *this;
+  }
+
+  DenseIdMapIterator operator++(int) {
+    DenseIdMapIterator it(*this);
+    ++*this;
+    return it;
+  }
+
+  DenseIdMapIterator& operator--() {
+    DCHECK(map_ != NULL);
+    index_ = map_->PreviousIndex(index_);
+    return *this;
+  }
+
+  DenseIdMapIterator operator--(int) {
+    DenseIdMapIterator it(*this);
+    --*this;
+    return it;
+  }
+
+  template<typename OtherMap, typename OtherValue>
+  bool operator==(
+      const DenseIdMapIterator<OtherMap, OtherValue>& other) const {
+    return index_ == other.index_;
+  }
+
+  template<typename OtherMap, typename OtherValue>
+  bool operator!=(
+      const DenseIdMapIterator<OtherMap, OtherValue>& other) const {
+    return index_ != other.index_;
+  }
+
+ private:
+  template<typename OtherMap, typename OtherValue>
+  friend class DenseIdMapIterator;
+  template<typename Key, typename T, size_t kChunkSize>
+  friend class core::DenseIdMap;
+
+  // The iterated map.
+  Map* map_;
+
+  // The index of the value pointed to, or Map::kEndIndex for the end.
+  size_t index_;
+};
+
+}  // namespace internal
+
+// A chunked vector map with the std::map interface. See the file comment for
+// the ways in which it differs from std::map.
+// @tparam Key the integral key type.
+// @tparam T the mapped type.
+// @tparam kChunkSize the number of values per chunk.
+template<typename Key, typename T, size_t kChunkSize>
+class DenseIdMap {
+ public:
+  typedef Key key_type;
+  typedef T mapped_type;
+  typedef std::pair<const Key, T> value_type;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+  typedef value_type& reference;
+  typedef const value_type& const_reference;
+  typedef internal::DenseIdMapIterator<DenseIdMap, value_type> iterator;
+  typedef internal::DenseIdMapIterator<const DenseIdMap, const value_type>
+      const_iterator;
+  typedef std::reverse_iterator<iterator> reverse_iterator;
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+  DenseIdMap() : size_(0) {
+  }
+
+  ~DenseIdMap() {
+    clear();
+  }
+
+  // @name Iteration.
+  // @{
+  iterator begin() { return iterator(this, NextIndex(0)); }
+  const_iterator begin() const { return const_iterator(this, NextIndex(0)); }
+  iterator end() { return iterator(this, kEndIndex); }
+  const_iterator end() const { return const_iterator(this, kEndIndex); }
+  reverse_iterator rbegin() { return reverse_iterator(end()); }
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(end());
+  }
+  reverse_iterator rend() { return reverse_iterator(begin()); }
+  const_reverse_iterator rend() const {
+    return const_reverse_iterator(begin());
+  }
+  // @}
+
+  // @name Capacity.
+  // @{
+  bool empty() const { return size_ == 0; }
+  size_type size() const { return size_; }
+  // @}
+
+  // Inserts @p value if no value with the same key is present.
+  // @param value the value to insert.
+  // @returns an iterator to the value with the key of @p value, and true iff
+  //     the value was freshly inserted.
+  std::pair<iterator, bool> insert(const value_type& value) {
+    size_t index = IndexOf(value.first);
+    if (index < occupied_.size() && occupied_[index])
+      return std::make_pair(iterator(this, index), false);
+
+    if (index >= occupied_.size())
+      occupied_.resize(index + 1, false);
+    size_t chunk = index / kChunkSize;
+    if (chunk >= chunks_.size())
+      chunks_.resize(chunk + 1, NULL);
+    if (chunks_[chunk] == NULL) {
+      chunks_[chunk] = static_cast<value_type*>(
+          ::operator new(kChunkSize * sizeof(value_type)));
+    }
+
+    new (GetSlot(index)) value_type(value);
+    occupied_[index] = true;
+    ++size_;
+    return std::make_pair(iterator(this, index), true);
+  }
+
+  // @name Erasure.
+  // @{
+  iterator erase(iterator position) {
+    DCHECK(position != end());
+    size_t index = position.index_;
+    DCHECK(occupied_[index]);
+    GetSlot(index)->~value_type();
+    occupied_[index] = false;
+    --size_;
+    return iterator(this, NextIndex(index + 1));
+  }
+  size_type erase(const key_type& key) {
+    iterator it = find(key);
+    if (it == end())
+      return 0;
+    erase(it);
+    return 1;
+  }
+  void clear() {
+    for (size_t i = 0; i < occupied_.size(); ++i) {
+      if (occupied_[i])
+        GetSlot(i)->~value_type();
+    }
+    for (size_t i = 0; i < chunks_.size(); ++i)
+      ::operator delete(chunks_[i]);
+    chunks_.clear();
+    occupied_.clear();
+    size_ = 0;
+  }
+  // @}
+
+  // Swaps the contents of this container with @p other.
+  void swap(DenseIdMap& other) {
+    chunks_.swap(other.chunks_);
+    occupied_.swap(other.occupied_);
+    std::swap(size_, other.size_);
+  }
+
+  // @name Lookup.
+  // @{
+  iterator find(const key_type& key) {
+    return iterator(this, FindIndex(key));
+  }
+  const_iterator find(const key_type& key) const {
+    return const_iterator(this, FindIndex(key));
+  }
+  size_type count(const key_type& key) const {
+    return FindIndex(key) == kEndIndex ? 0 : 1;
+  }
+  // @}
+
+ private:
+  template<typename Map, typename Value>
+  friend class internal::DenseIdMapIterator;
+
+  // The index of the end of the map.
+  static const size_t kEndIndex = static_cast<size_t>(-1);
+
+  // @returns the index of the slot of @p key.
+  static size_t IndexOf(const key_type& key) {
+    DCHECK(!(key < key_type()));
+    return static_cast<size_t>(key);
+  }
+
+  // @returns the slot at @p index. Its chunk must be allocated.
+  value_type* GetSlot(size_t index) const {
+    DCHECK_LT(index, occupied_.size());
+    DCHECK(chunks_[index / kChunkSize] != NULL);
+    return chunks_[index / kChunkSize] + index % kChunkSize;
+  }
+
+  // @returns the index of the value of @p key, or kEndIndex if there is none.
+  size_t FindIndex(const key_type& key) const {
+    size_t index = IndexOf(key);
+    if (index < occupied_.size() && occupied_[index])
+      return index;
+    return kEndIndex;
+  }
+
+  // @returns the index of the first value at or after @p index, or kEndIndex
+  //     if there is none.
+  size_t NextIndex(size_t index) const {
+    for (; index < occupied_.size(); ++index) {
+      if (occupied_[index])
+        return index;
+    }
+    return kEndIndex;
+  }
+
+  // @returns the index of the last value before @p index, which may be
+  //     kEndIndex.
+  size_t PreviousIndex(size_t index) const {
+    if (index == kEndIndex)
+      index = occupied_.size();
+    while (index > 0) {
+      --index;
+      if (occupied_[index])
+        return index;
+    }
+    NOTREACHED() << "Decrementing the begin of a DenseIdMap.";
+    return kEndIndex;
+  }
+
+  // The chunks of slots. A chunk is only allocated once a value is inserted
+  // in its range of keys.
+  std::vector<value_type*> chunks_;
+
+  // Whether each slot holds a value.
+  std::vector<bool> occupied_;
+
+  // The number of values.
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(DenseIdMap);
+};
+
+template<typename Key, typename T, size_t kChunkSize>
+const size_t DenseIdMap<Key, T, kChunkSize>::kEndIndex;
+
+}  // namespace core
+
+#endif  // SYZYGY_CORE_DENSE_ID_MAP_H_
@@ -0,0 +1,218 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/dense_id_map.h"
+
+#include <map>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "syzygy/core/random_number_generator.h"
+
+namespace core {
+
+namespace {
+
+// A small chunk size, so that the tests span several chunks.
+typedef DenseIdMap<int, int, 4> IntDenseIdMap;
+
+// Counts the live instances, to check that the values are destroyed.
+class Counted {
+ public:
+  Counted() { ++instances_; }
+  Counted(const Counted& other) { ++instances_; }
+  ~Counted() { --instances_; }
+
+  static int instances_;
+};
+
+int Counted::instances_ = 0;
+
+// Returns true iff @p dense_map and @p std_map hold the same key/value pairs.
+bool MapsEqual(const IntDenseIdMap& dense_map,
+               const std::map<int, int>& std_map) {
+  if (dense_map.size() != std_map.size())
+    return false;
+
+  IntDenseIdMap::const_iterator dense_it = dense_map.begin();
+  std::map<int, int>::const_iterator std_it = std_map.begin();
+  for (; dense_it != dense_map.end(); ++dense_it, ++std_it) {
+    if (dense_it->first != std_it->first ||
+        dense_it->second != std_it->second) {
+      return false;
+    }
+  }
+
+  return std_it == std_map.end();
+}
+
+}  // namespace
+
+TEST(DenseIdMapTest, DefaultConstructor) {
+  IntDenseIdMap map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(0u, map.size());
+  EXPECT_TRUE(map.begin() == map.end());
+  EXPECT_TRUE(map.rbegin() == map.rend());
+}
+
+TEST(DenseIdMapTest, InsertAndFind) {
+  IntDenseIdMap map;
+
+  EXPECT_TRUE(map.insert(std::make_pair(5, 50)).second);
+  EXPECT_TRUE(map.insert(std::make_pair(1, 10)).second);
+  EXPECT_TRUE(map.insert(std::make_pair(9, 90)).second);
+  EXPECT_FALSE(map.insert(std::make_pair(5, 55)).second);
+  EXPECT_EQ(3u, map.size());
+
+  IntDenseIdMap::iterator it = map.find(5);
+  ASSERT_TRUE(it != map.end());
+  EXPECT_EQ(5, it->first);
+  EXPECT_EQ(50, it->second);
+  EXPECT_EQ(1u, map.count(9));
+
+  // Keys past the end, and in unallocated chunks, aren't found.
+  EXPECT_TRUE(map.find(3) == map.end());
+  EXPECT_TRUE(map.find(100) == map.end());
+  EXPECT_EQ(0u, map.count(100));
+}
+
+TEST(DenseIdMapTest, IteratesInKeyOrder) {
+  IntDenseIdMap map;
+  map.insert(std::make_pair(12, 120));
+  map.insert(std::make_pair(2, 20));
+  map.insert(std::make_pair(7, 70));
+
+  IntDenseIdMap::const_iterator it = map.begin();
+  ASSERT_TRUE(it != map.end());
+  EXPECT_EQ(2, it->first);
+  ASSERT_TRUE(++it != map.end());
+  EXPECT_EQ(7, it->first);
+  ASSERT_TRUE(++it != map.end());
+  EXPECT_EQ(12, it->first);
+  EXPECT_TRUE(++it == map.end());
+
+  // Walking backwards from the end visits the values in reverse.
+  EXPECT_EQ(12, (--it)->first);
+  IntDenseIdMap::reverse_iterator rit = map.rbegin();
+  EXPECT_EQ(12, rit->first);
+  ++rit;
+  EXPECT_EQ(7, rit->first);
+  ++rit;
+  EXPECT_EQ(2, rit->first);
+  EXPECT_TRUE(++rit == map.rend());
+}
+
+TEST(DenseIdMapTest, EraseLeavesOtherValuesInPlace) {
+  IntDenseIdMap map;
+  for (int i = 0; i < 10; ++i)
+    map.insert(std::make_pair(i, i * 10));
+
+  const IntDenseIdMap::value_type* value = &*map.find(6);
+  IntDenseIdMap::iterator end = map.end();
+
+  // Erasing returns the following value.
+  IntDenseIdMap::iterator it = map.erase(map.find(5));
+  ASSERT_TRUE(it != map.end());
+  EXPECT_EQ(6, it->first);
+  EXPECT_EQ(1u, map.erase(3));
+  EXPECT_EQ(0u, map.erase(3));
+  EXPECT_EQ(8u, map.size());
+
+  // Inserting more values doesn't move the existing ones or the end.
+  for (int i = 10; i < 100; ++i)
+    map.insert(std::make_pair(i, i * 10));
+  EXPECT_EQ(value, &*map.find(6));
+  EXPECT_TRUE(end == map.end());
+
+  // The tombstones are skipped, and can be reused.
+  it = map.find(2);
+  EXPECT_EQ(4, (++it)->first);
+  EXPECT_TRUE(map.insert(std::make_pair(3, 33)).second);
+  EXPECT_EQ(33, map.find(3)->second);
+}
+
+TEST(DenseIdMapTest, DestroysValues) {
+  {
+    DenseIdMap<int, Counted, 4> map;
+    for (int i = 0; i < 10; ++i)
+      map.insert(std::make_pair(i, Counted()));
+    EXPECT_EQ(10, Counted::instances_);
+
+    map.erase(4);
+    EXPECT_EQ(9, Counted::instances_);
+
+    map.clear();
+    EXPECT_EQ(0, Counted::instances_);
+    EXPECT_TRUE(map.empty());
+
+    map.insert(std::make_pair(1, Counted()));
+    EXPECT_EQ(1, Counted::instances_);
+  }
+  EXPECT_EQ(0, Counted::instances_);
+}
+
+TEST(DenseIdMapTest, Swap) {
+  IntDenseIdMap map1;
+  IntDenseIdMap map2;
+  map1.insert(std::make_pair(1, 10));
+  map2.insert(std::make_pair(2, 20));
+  map2.insert(std::make_pair(3, 30));
+
+  map1.swap(map2);
+  EXPECT_EQ(2u, map1.size());
+  EXPECT_EQ(1u, map2.size());
+  EXPECT_EQ(20, map1.find(2)->second);
+  EXPECT_EQ(10, map2.find(1)->second);
+}
+
+TEST(DenseIdMapTest, BehavesLikeStdMap) {
+  RandomNumberGenerator rng(42);
+  IntDenseIdMap dense_map;
+  std::map<int, int> std_map;
+
+  for (size_t i = 0; i < 5000; ++i) {
+    int key = rng(200);
+    int value = rng(1000);
+    switch (rng(3)) {
+      case 0: {
+        bool dense_inserted = dense_map.insert(
+            std::make_pair(key, value)).second;
+        bool std_inserted = std_map.insert(std::make_pair(key, value)).second;
+        ASSERT_EQ(std_inserted, dense_inserted);
+        break;
+      }
+
+      case 1: {
+        ASSERT_EQ(std_map.erase(key), dense_map.erase(key));
+        break;
+      }
+
+      case 2: {
+        IntDenseIdMap::iterator dense_it = dense_map.find(key);
+        std::map<int, int>::iterator std_it = std_map.find(key);
+        ASSERT_EQ(std_it == std_map.end(), dense_it == dense_map.end());
+        if (std_it != std_map.end()) {
+          dense_it->second = value;
+          std_it->second = value;
+        }
+        break;
+      }
+    }
+
+    ASSERT_TRUE(MapsEqual(dense_map, std_map));
+  }
+}
+
+}  // namespace core
@@ -15,6 +15,9 @@
 // Implementation of disassembler.
 #include "syzygy/core/disassembler.h"
 
+#include <algorithm>
+#include <functional>
+
 #include "base/logging.h"
 #include "base/stringprintf.h"
 #include "syzygy/core/disassembler_util.h"
@@ -29,6 +32,9 @@ Disassembler::Disassembler(const uint8* code,
       code_size_(code_size),
       code_addr_(code_addr),
       on_instruction_(on_instruction),
+      unvisited_offsets_(code_size),
+      visited_offsets_(code_size),
+      instruction_offsets_(code_size),
       disassembled_bytes_(0) {
 }
 
@@ -41,6 +47,9 @@ Disassembler::Disassembler(const uint8* code,
       code_size_(code_size),
       code_addr_(code_addr),
       on_instruction_(on_instruction),
+      unvisited_offsets_(code_size),
+      visited_offsets_(code_size),
+      instruction_offsets_(code_size),
       disassembled_bytes_(0) {
 
   AddressSet::const_iterator it = entry_points.begin();
@@ -85,9 +94,11 @@ Disassembler::WalkResult Disassembler::Walk() {
   bool incomplete_branches = false;
 
   while (!unvisited_.empty()) {
-    AddressSet::iterator it = unvisited_.begin();
-    AbsoluteAddress addr(*it);
-    unvisited_.erase(it);
+    std::pop_heap(unvisited_.begin(), unvisited_.end(),
+                  std::greater<AbsoluteAddress>());
+    AbsoluteAddress addr(unvisited_.back());
+    unvisited_.pop_back();
+    unvisited_offsets_[OffsetOf(addr)] = false;
 
     // Unvisited addresses must be within the code block we're currently
     // disassembling.
@@ -138,17 +149,21 @@ Disassembler::WalkResult Disassembler::Walk() {
       CHECK_EQ(1U, decoded);
       CHECK(result == DECRES_MEMORYERR || result == DECRES_SUCCESS);
 
-      // Try to visit this instruction.
-      VisitedSpace::Range range(addr, inst.size);
-      if (!visited_.Insert(range, 0)) {
-        // If the collision is a repeat of a previously disassembled
-        // instruction at a different offset then something went wrong.
-        if (!visited_.ContainsExactly(range)) {
+      // Try to visit this instruction. Decoding the same bytes yields the
+      // same instruction, so an instruction already starting here is a
+      // repeat. Any other collision means that something went wrong.
+      size_t offset = OffsetOf(addr);
+      if (instruction_offsets_[offset])
+        break;
+      size_t end = std::min(offset + inst.size, code_size_);
+      for (size_t i = offset; i < end; ++i) {
+        if (visited_offsets_[i]) {
           LOG(ERROR) << "Two disassembled instructions overlap.";
           return kWalkError;
         }
-        break;
+        visited_offsets_[i] = true;
       }
+      instruction_offsets_[offset] = true;
 
       // Tally the code bytes we just disassembled.
       disassembled_bytes_ += inst.size;
@@ -253,7 +268,8 @@ Disassembler::WalkResult Disassembler::Walk() {
       // If the next instruction is flagged as a disassembly start point, we
       // should end this run of instructions (basic-block) and let it be picked
       // up on the next iteration.
-      if (unvisited_.count(addr + inst.size) != 0 && !terminate) {
+      if (!terminate && IsInBlock(addr + inst.size) &&
+          unvisited_offsets_[OffsetOf(addr + inst.size)]) {
         control_flow = kControlFlowContinues;
         terminate = true;
       }
@@ -283,10 +299,25 @@ Disassembler::WalkResult Disassembler::Walk() {
 bool Disassembler::Unvisited(AbsoluteAddress addr) {
   DCHECK(IsInBlock(addr));
 
-  if (visited_.Intersects(addr))
+  size_t offset = OffsetOf(addr);
+  if (visited_offsets_[offset] || unvisited_offsets_[offset])
     return false;
 
-  return unvisited_.insert(addr).second;
+  unvisited_offsets_[offset] = true;
+  unvisited_.push_back(addr);
+  std::push_heap(unvisited_.begin(), unvisited_.end(),
+                 std::greater<AbsoluteAddress>());
+  return true;
+}
+
+bool Disassembler::IsVisited(AbsoluteAddress addr) const {
+  DCHECK(IsInBlock(addr));
+  return visited_offsets_[OffsetOf(addr)];
+}
+
+bool Disassembler::IsInstructionStart(AbsoluteAddress addr) const {
+  DCHECK(IsInBlock(addr));
+  return instruction_offsets_[OffsetOf(addr)];
 }
 
 Disassembler::CallbackDirective Disassembler::NotifyOnInstruction(
@@ -306,4 +337,9 @@ bool Disassembler::IsInBlock(AbsoluteAddress addr) const {
       static_cast<size_t>(addr - code_addr_) + 1 <= code_size_;
 }
 
+size_t Disassembler::OffsetOf(AbsoluteAddress addr) const {
+  DCHECK(IsInBlock(addr));
+  return addr - code_addr_;
+}
+
 }  // namespace core
@@ -17,10 +17,11 @@
 #define SYZYGY_CORE_DISASSEMBLER_H_
 
 #include <set>
+#include <vector>
+
 #include "base/basictypes.h"
 #include "base/callback.h"
 #include "syzygy/core/address.h"
-#include "syzygy/core/address_space.h"
 #include "distorm.h"  // NOLINT
 
 namespace core {
@@ -28,7 +29,6 @@ namespace core {
 class Disassembler {
  public:
   typedef std::set<AbsoluteAddress> AddressSet;
-  typedef core::AddressSpace<AbsoluteAddress, size_t, uint8> VisitedSpace;
 
   enum CallbackDirective {
     // Indicates that the disassembler should continue.
@@ -98,6 +98,16 @@ class Disassembler {
   // @pre IsInCode(addr, 1).
   bool Unvisited(AbsoluteAddress addr);
 
+  // @param addr The address to check.
+  // @returns true iff @p addr is covered by a disassembled instruction.
+  // @pre IsInBlock(addr).
+  bool IsVisited(AbsoluteAddress addr) const;
+
+  // @param addr The address to check.
+  // @returns true iff an instruction was disassembled at @p addr.
+  // @pre IsInBlock(addr).
+  bool IsInstructionStart(AbsoluteAddress addr) const;
+
   // Attempts to walk function from known entry points.
   // Invokes callback for every instruction as it's encountered.
   // @returns the results of the walk.
@@ -110,8 +120,6 @@ class Disassembler {
   const uint8* code() const { return code_; }
   size_t code_size() const { return code_size_; }
   const AbsoluteAddress code_addr() const { return code_addr_; }
-  const AddressSet& unvisited() const { return unvisited_; }
-  const VisitedSpace& visited() const { return visited_; }
   size_t disassembled_bytes() const { return disassembled_bytes_; }
   // @}
 
@@ -174,12 +182,23 @@ class Disassembler {
   // Invoke this callback on every instruction.
   InstructionCallback on_instruction_;
 
-  // Unvisited instruction locations before and during a walk.
-  // This is seeded by the code entry point(s), and will also contain
-  // branch targets during disassembly.
-  AddressSet unvisited_;
-  // Each visited instruction is stored as a range in this space.
-  VisitedSpace visited_;
+  // @param addr An address in the code.
+  // @returns the offset of @p addr in the code.
+  size_t OffsetOf(AbsoluteAddress addr) const;
+
+  // The state of the walk is kept in dense bitmaps over the code, indexed by
+  // offset, so that disassembling doesn't allocate once they're sized.
+
+  // Unvisited instruction locations before and during a walk, kept as a heap
+  // with the lowest address on top. This is seeded by the code entry
+  // point(s), and will also contain branch targets during disassembly.
+  std::vector<AbsoluteAddress> unvisited_;
+  // The offsets which are in unvisited_.
+  std::vector<bool> unvisited_offsets_;
+  // The offsets covered by a visited instruction.
+  std::vector<bool> visited_offsets_;
+  // The offsets at which a visited instruction starts.
+  std::vector<bool> instruction_offsets_;
 
   // Number of bytes disassembled to this point during walk.
   size_t disassembled_bytes_;
@@ -161,6 +161,38 @@ TEST_F(DisassemblerTest, DisassembleFull) {
       disasm.disassembled_bytes());
 }
 
+TEST_F(DisassemblerTest, TracksVisitedInstructions) {
+  size_t code_size = PointerTo(&assembly_func_end) - PointerTo(&assembly_func);
+  Disassembler disasm(PointerTo(&assembly_func),
+                      code_size,
+                      AddressOf(&assembly_func),
+                      on_instruction_);
+  ASSERT_TRUE(disasm.Unvisited(AddressOf(&assembly_func)));
+  ASSERT_TRUE(disasm.Unvisited(AddressOf(&internal_label)));
+  // An entry point is only added once.
+  EXPECT_FALSE(disasm.Unvisited(AddressOf(&internal_label)));
+  EXPECT_FALSE(disasm.IsVisited(AddressOf(&assembly_func)));
+
+  EXPECT_CALL(*this, OnInstruction(_, _)).Times(7).
+      WillRepeatedly(Return(Disassembler::kDirectiveContinue));
+  ASSERT_EQ(Disassembler::kWalkSuccess, disasm.Walk());
+
+  // Every byte is covered by one of the 7 instructions, which start at both
+  // entry points.
+  size_t instruction_count = 0;
+  for (size_t i = 0; i < code_size; ++i) {
+    EXPECT_TRUE(disasm.IsVisited(AddressOf(&assembly_func) + i));
+    if (disasm.IsInstructionStart(AddressOf(&assembly_func) + i))
+      ++instruction_count;
+  }
+  EXPECT_EQ(7U, instruction_count);
+  EXPECT_TRUE(disasm.IsInstructionStart(AddressOf(&assembly_func)));
+  EXPECT_TRUE(disasm.IsInstructionStart(AddressOf(&internal_label)));
+
+  // Visited addresses are not walked again.
+  EXPECT_FALSE(disasm.Unvisited(AddressOf(&assembly_func)));
+}
+
 TEST_F(DisassemblerTest, EncounterFunctions) {
   Disassembler disasm(PointerTo(&assembly_func),
                       PointerTo(&assembly_func_end) - PointerTo(&assembly_func),
@@ -0,0 +1,369 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares FlatMap and FlatSet, sorted-vector implementations of the subset
+// of the std::map and std::set interfaces used throughout Syzygy. They trade
+// O(N) insertion and erasure for contiguous storage, which makes lookups and
+// iteration considerably more cache friendly and cuts the per-element memory
+// overhead of the node based containers.
+//
+// There are two notable differences with respect to the standard containers:
+//
+// - Any insertion or erasure invalidates all iterators and references into
+//   the container, not only those to the erased element.
+// - The value type of a FlatMap is std::pair<Key, T> rather than
+//   std::pair<const Key, T>. Modifying the key of an element through an
+//   iterator will break the container's invariants; don't do it.
+//
+// Inserting elements in increasing key order is amortized O(1), and the
+// range insertion is O((N + M) log M), so containers are best built from
+// already sorted data or in bulk.
+
+#ifndef SYZYGY_CORE_FLAT_MAP_H_
+#define SYZYGY_CORE_FLAT_MAP_H_
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "base/logging.h"
+
+namespace core {
+
+namespace internal {
+
+// Extracts the key from a FlatSet value.
+template<typename Value>
+struct IdentityKey {
+  const Value& operator()(const Value& value) const { return value; }
+};
+
+// Extracts the key from a FlatMap value.
+template<typename Pair>
+struct FirstKey {
+  const typename Pair::first_type& operator()(const Pair& value) const {
+    return value.first;
+  }
+};
+
+// The shared implementation of FlatMap and FlatSet. The values are kept in a
+// vector sorted by key, with no two values having equivalent keys.
+// @tparam Key the key type.
+// @tparam Value the value type stored in the container.
+// @tparam KeyOf a functor extracting a const Key& from a const Value&.
+// @tparam Compare the strict weak ordering used to compare keys.
+template<typename Key, typename Value, typename KeyOf, typename Compare>
+class FlatTree {
+ public:
+  typedef Key key_type;
+  typedef Value value_type;
+  typedef Compare key_compare;
+  typedef std::vector<Value> Storage;
+  typedef typename Storage::size_type size_type;
+  typedef typename Storage::difference_type difference_type;
+  typedef typename Storage::reference reference;
+  typedef typename Storage::const_reference const_reference;
+  typedef typename Storage::iterator iterator;
+  typedef typename Storage::const_iterator const_iterator;
+  typedef typename Storage::reverse_iterator reverse_iterator;
+  typedef typename Storage::const_reverse_iterator const_reverse_iterator;
+
+  FlatTree() {
+  }
+
+  explicit FlatTree(const Compare& comp) : comp_(comp) {
+  }
+
+  template<typename InputIterator>
+  FlatTree(InputIterator first, InputIterator last) {
+    insert(first, last);
+  }
+
+  // @name Iteration.
+  // @{
+  iterator begin() { return values_.begin(); }
+  const_iterator begin() const { return values_.begin(); }
+  iterator end() { return values_.end(); }
+  const_iterator end() const { return values_.end(); }
+  reverse_iterator rbegin() { return values_.rbegin(); }
+  const_reverse_iterator rbegin() const { return values_.rbegin(); }
+  reverse_iterator rend() { return values_.rend(); }
+  const_reverse_iterator rend() const { return values_.rend(); }
+  // @}
+
+  // @name Capacity.
+  // @{
+  bool empty() const { return values_.empty(); }
+  size_type size() const { return values_.size(); }
+  size_type capacity() const { return values_.capacity(); }
+  void reserve(size_type count) { values_.reserve(count); }
+  // @}
+
+  // Inserts @p value if no value with an equivalent key is present.
+  // @param value the value to insert.
+  // @returns an iterator to the value with the key of @p value, and true iff
+  //     the value was freshly inserted.
+  std::pair<iterator, bool> insert(const value_type& value) {
+    const Key& key = KeyOf()(value);
+
+    // Appending in increasing key order is by far the most common pattern
+    // when building these containers, so make it cheap.
+    if (values_.empty() || comp_(KeyOf()(values_.back()), key)) {
+      values_.push_back(value);
+      return std::make_pair(values_.end() - 1, true);
+    }
+
+    iterator it = lower_bound(key);
+    if (it != values_.end() && !comp_(key, KeyOf()(*it)))
+      return std::make_pair(it, false);
+
+    it = values_.insert(it, value);
+    return std::make_pair(it, true);
+  }
+
+  // Inserts @p value if no value with an equivalent key is present, using
+  // @p hint as the insertion position if the value belongs right before it.
+  // This makes insertion at a known position O(1) plus the cost of moving the
+  // following values.
+  // @param hint the position before which @p value is expected to go.
+  // @param value the value to insert.
+  // @returns an iterator to the value with the key of @p value.
+  iterator insert(iterator hint, const value_type& value) {
+    const Key& key = KeyOf()(value);
+    if ((hint == values_.begin() || comp_(KeyOf()(*(hint - 1)), key)) &&
+        (hint == values_.end() || comp_(key, KeyOf()(*hint)))) {
+      return values_.insert(hint, value);
+    }
+    return insert(value).first;
+  }
+
+  // Inserts the values in the range [@p first, @p last). As with the standard
+  // containers, values whose keys are already present are ignored, and the
+  // first of several values with equivalent keys wins.
+  template<typename InputIterator>
+  void insert(InputIterator first, InputIterator last) {
+    difference_type old_size = values_.size();
+    values_.insert(values_.end(), first, last);
+    iterator middle = values_.begin() + old_size;
+    if (middle == values_.end())
+      return;
+
+    // Both the sort and the merge are stable, so the values that were already
+    // present precede any newly inserted equivalent ones, and std::unique
+    // keeps the first of each run.
+    ValueCompare value_comp(comp_);
+    std::stable_sort(middle, values_.end(), value_comp);
+    // There's no need to merge if the new values all sort after the existing
+    // ones. This is the bulk analog of the fast append path above.
+    if (middle != values_.begin() && !value_comp(*(middle - 1), *middle))
+      std::inplace_merge(values_.begin(), middle, values_.end(), value_comp);
+    values_.erase(std::unique(values_.begin(), values_.end(),
+                              ValueEquivalent(comp_)),
+                  values_.end());
+  }
+
+  // @name Erasure.
+  // @{
+  iterator erase(iterator position) {
+    DCHECK(position != values_.end());
+    return values_.erase(position);
+  }
+  iterator erase(iterator first, iterator last) {
+    return values_.erase(first, last);
+  }
+  size_type erase(const key_type& key) {
+    iterator it = find(key);
+    if (it == values_.end())
+      return 0;
+    values_.erase(it);
+    return 1;
+  }
+  void clear() { values_.clear(); }
+  // @}
+
+  // Swaps the contents of this container with @p other.
+  void swap(FlatTree& other) {
+    values_.swap(other.values_);
+    std::swap(comp_, other.comp_);
+  }
+
+  // @name Lookup.
+  // @{
+  iterator find(const key_type& key) {
+    iterator it = lower_bound(key);
+    if (it != values_.end() && comp_(key, KeyOf()(*it)))
+      return values_.end();
+    return it;
+  }
+  const_iterator find(const key_type& key) const {
+    const_iterator it = lower_bound(key);
+    if (it != values_.end() && comp_(key, KeyOf()(*it)))
+      return values_.end();
+    return it;
+  }
+  size_type count(const key_type& key) const {
+    return find(key) == values_.end() ? 0 : 1;
+  }
+  iterator lower_bound(const key_type& key) {
+    return values_.begin() + LowerBoundIndex(key);
+  }
+  const_iterator lower_bound(const key_type& key) const {
+    return values_.begin() + LowerBoundIndex(key);
+  }
+  iterator upper_bound(const key_type& key) {
+    return values_.begin() + UpperBoundIndex(key);
+  }
+  const_iterator upper_bound(const key_type& key) const {
+    return values_.begin() + UpperBoundIndex(key);
+  }
+  std::pair<iterator, iterator> equal_range(const key_type& key) {
+    return std::make_pair(lower_bound(key), upper_bound(key));
+  }
+  std::pair<const_iterator, const_iterator> equal_range(
+      const key_type& key) const {
+    return std::make_pair(lower_bound(key), upper_bound(key));
+  }
+  // @}
+
+  key_compare key_comp() const { return comp_; }
+
+  bool operator==(const FlatTree& other) const {
+    return values_ == other.values_;
+  }
+  bool operator!=(const FlatTree& other) const {
+    return values_ != other.values_;
+  }
+
+ private:
+  // Orders values by their keys.
+  struct ValueCompare {
+    explicit ValueCompare(const Compare& comp) : comp(comp) { }
+    bool operator()(const Value& v1, const Value& v2) const {
+      return comp(KeyOf()(v1), KeyOf()(v2));
+    }
+    Compare comp;
+  };
+
+  // Returns true iff two values have equivalent keys.
+  struct ValueEquivalent {
+    explicit ValueEquivalent(const Compare& comp) : comp(comp) { }
+    bool operator()(const Value& v1, const Value& v2) const {
+      return !comp(KeyOf()(v1), KeyOf()(v2)) &&
+          !comp(KeyOf()(v2), KeyOf()(v1));
+    }
+    Compare comp;
+  };
+
+  // Returns the index of the first value whose key is not less than @p key.
+  // These are hand-rolled rather than using std::lower_bound and friends with
+  // a heterogeneous comparator, as the debug STL insists on being able to
+  // compare two values with the predicate.
+  size_type LowerBoundIndex(const key_type& key) const {
+    size_type first = 0;
+    size_type count = values_.size();
+    while (count > 0) {
+      size_type step = count / 2;
+      if (comp_(KeyOf()(values_[first + step]), key)) {
+        first += step + 1;
+        count -= step + 1;
+      } else {
+        count = step;
+      }
+    }
+    return first;
+  }
+
+  // Returns the index of the first value whose key is greater than @p key.
+  size_type UpperBoundIndex(const key_type& key) const {
+    size_type first = 0;
+    size_type count = values_.size();
+    while (count > 0) {
+      size_type step = count / 2;
+      if (!comp_(key, KeyOf()(values_[first + step]))) {
+        first += step + 1;
+        count -= step + 1;
+      } else {
+        count = step;
+      }
+    }
+    return first;
+  }
+
+  Storage values_;
+  Compare comp_;
+};
+
+}  // namespace internal
+
+// A sorted-vector map with the std::map interface. See the file comment for
+// the ways in which it differs from std::map.
+template<typename Key, typename T, typename Compare = std::less<Key> >
+class FlatMap
+    : public internal::FlatTree<Key,
+                                std::pair<Key, T>,
+                                internal::FirstKey<std::pair<Key, T> >,
+                                Compare> {
+ public:
+  typedef internal::FlatTree<Key,
+                             std::pair<Key, T>,
+                             internal::FirstKey<std::pair<Key, T> >,
+                             Compare> Super;
+  typedef T mapped_type;
+
+  FlatMap() {
+  }
+
+  explicit FlatMap(const Compare& comp) : Super(comp) {
+  }
+
+  template<typename InputIterator>
+  FlatMap(InputIterator first, InputIterator last) : Super(first, last) {
+  }
+
+  // Returns the value mapped to @p key, inserting a default constructed one if
+  // there is none yet.
+  mapped_type& operator[](const Key& key) {
+    return this->insert(std::make_pair(key, mapped_type())).first->second;
+  }
+};
+
+// A sorted-vector set with the std::set interface. See the file comment for
+// the ways in which it differs from std::set.
+template<typename Key, typename Compare = std::less<Key> >
+class FlatSet
+    : public internal::FlatTree<Key,
+                                Key,
+                                internal::IdentityKey<Key>,
+                                Compare> {
+ public:
+  typedef internal::FlatTree<Key,
+                             Key,
+                             internal::IdentityKey<Key>,
+                             Compare> Super;
+
+  FlatSet() {
+  }
+
+  explicit FlatSet(const Compare& comp) : Super(comp) {
+  }
+
+  template<typename InputIterator>
+  FlatSet(InputIterator first, InputIterator last) : Super(first, last) {
+  }
+};
+
+}  // namespace core
+
+#endif  // SYZYGY_CORE_FLAT_MAP_H_
@@ -0,0 +1,247 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/flat_map.h"
+
+#include <map>
+#include <set>
+
+#include "gtest/gtest.h"
+#include "syzygy/core/random_number_generator.h"
+
+namespace core {
+
+namespace {
+
+typedef FlatMap<int, int> IntFlatMap;
+typedef FlatSet<int> IntFlatSet;
+
+// Returns true iff @p flat_map and @p std_map hold the same key/value pairs.
+bool MapsEqual(const IntFlatMap& flat_map, const std::map<int, int>& std_map) {
+  if (flat_map.size() != std_map.size())
+    return false;
+
+  IntFlatMap::const_iterator flat_it = flat_map.begin();
+  std::map<int, int>::const_iterator std_it = std_map.begin();
+  for (; flat_it != flat_map.end(); ++flat_it, ++std_it) {
+    if (flat_it->first != std_it->first || flat_it->second != std_it->second)
+      return false;
+  }
+
+  return true;
+}
+
+}  // namespace
+
+TEST(FlatMapTest, DefaultConstructor) {
+  IntFlatMap map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(0u, map.size());
+  EXPECT_TRUE(map.begin() == map.end());
+}
+
+TEST(FlatMapTest, InsertAndFind) {
+  IntFlatMap map;
+
+  EXPECT_TRUE(map.insert(std::make_pair(5, 50)).second);
+  EXPECT_TRUE(map.insert(std::make_pair(1, 10)).second);
+  EXPECT_TRUE(map.insert(std::make_pair(9, 90)).second);
+  EXPECT_TRUE(map.insert(std::make_pair(3, 30)).second);
+
+  // Inserting an existing key does not replace its value.
+  std::pair<IntFlatMap::iterator, bool> result =
+      map.insert(std::make_pair(5, 55));
+  EXPECT_FALSE(result.second);
+  EXPECT_EQ(5, result.first->first);
+  EXPECT_EQ(50, result.first->second);
+
+  EXPECT_EQ(4u, map.size());
+
+  // The values are in order.
+  IntFlatMap::const_iterator it = map.begin();
+  EXPECT_EQ(1, (it++)->first);
+  EXPECT_EQ(3, (it++)->first);
+  EXPECT_EQ(5, (it++)->first);
+  EXPECT_EQ(9, (it++)->first);
+  EXPECT_TRUE(it == map.end());
+
+  EXPECT_TRUE(map.find(0) == map.end());
+  EXPECT_TRUE(map.find(4) == map.end());
+  EXPECT_TRUE(map.find(10) == map.end());
+  ASSERT_TRUE(map.find(3) != map.end());
+  EXPECT_EQ(30, map.find(3)->second);
+  EXPECT_EQ(1u, map.count(9));
+  EXPECT_EQ(0u, map.count(8));
+}
+
+TEST(FlatMapTest, Bounds) {
+  IntFlatMap map;
+  map[2] = 20;
+  map[4] = 40;
+  map[6] = 60;
+
+  EXPECT_EQ(2, map.lower_bound(1)->first);
+  EXPECT_EQ(2, map.lower_bound(2)->first);
+  EXPECT_EQ(4, map.lower_bound(3)->first);
+  EXPECT_TRUE(map.lower_bound(7) == map.end());
+
+  EXPECT_EQ(2, map.upper_bound(1)->first);
+  EXPECT_EQ(4, map.upper_bound(2)->first);
+  EXPECT_TRUE(map.upper_bound(6) == map.end());
+
+  std::pair<IntFlatMap::iterator, IntFlatMap::iterator> range =
+      map.equal_range(4);
+  ASSERT_TRUE(range.first != range.second);
+  EXPECT_EQ(4, range.first->first);
+  EXPECT_EQ(6, range.second->first);
+
+  range = map.equal_range(5);
+  EXPECT_TRUE(range.first == range.second);
+}
+
+TEST(FlatMapTest, Subscript) {
+  IntFlatMap map;
+  map[3] = 30;
+  EXPECT_EQ(30, map[3]);
+  map[3] = 33;
+  EXPECT_EQ(33, map[3]);
+  EXPECT_EQ(0, map[7]);
+  EXPECT_EQ(2u, map.size());
+}
+
+TEST(FlatMapTest, Erase) {
+  IntFlatMap map;
+  for (int i = 0; i < 10; ++i)
+    map[i] = i;
+
+  EXPECT_EQ(1u, map.erase(4));
+  EXPECT_EQ(0u, map.erase(4));
+  EXPECT_EQ(9u, map.size());
+
+  IntFlatMap::iterator it = map.erase(map.find(5));
+  ASSERT_TRUE(it != map.end());
+  EXPECT_EQ(6, it->first);
+
+  map.erase(map.lower_bound(7), map.end());
+  EXPECT_EQ(5u, map.size());
+  EXPECT_EQ(6, map.rbegin()->first);
+
+  map.clear();
+  EXPECT_TRUE(map.empty());
+}
+
+TEST(FlatMapTest, RangeInsert) {
+  IntFlatMap map;
+  map[2] = 20;
+  map[8] = 80;
+
+  std::vector<std::pair<int, int> > values;
+  values.push_back(std::make_pair(5, 50));
+  values.push_back(std::make_pair(1, 10));
+  values.push_back(std::make_pair(8, 88));
+  values.push_back(std::make_pair(5, 55));
+
+  map.insert(values.begin(), values.end());
+
+  // Existing values and the first of several equivalent new values win.
+  std::map<int, int> expected;
+  expected[1] = 10;
+  expected[2] = 20;
+  expected[5] = 50;
+  expected[8] = 80;
+  EXPECT_TRUE(MapsEqual(map, expected));
+
+  // Inserting values that all sort after the existing ones.
+  values.clear();
+  values.push_back(std::make_pair(12, 120));
+  values.push_back(std::make_pair(10, 100));
+  map.insert(values.begin(), values.end());
+  expected[10] = 100;
+  expected[12] = 120;
+  EXPECT_TRUE(MapsEqual(map, expected));
+
+  // The range constructor.
+  IntFlatMap map2(expected.begin(), expected.end());
+  EXPECT_TRUE(map == map2);
+}
+
+TEST(FlatMapTest, BehavesLikeStdMap) {
+  RandomNumberGenerator rng(42);
+  IntFlatMap flat_map;
+  std::map<int, int> std_map;
+
+  for (size_t i = 0; i < 5000; ++i) {
+    int key = rng(200);
+    int value = rng(1000);
+    switch (rng(4)) {
+      case 0: {
+        bool flat_inserted = flat_map.insert(
+            std::make_pair(key, value)).second;
+        bool std_inserted = std_map.insert(std::make_pair(key, value)).second;
+        ASSERT_EQ(std_inserted, flat_inserted);
+        break;
+      }
+
+      case 1: {
+        ASSERT_EQ(std_map.erase(key), flat_map.erase(key));
+        break;
+      }
+
+      case 2: {
+        flat_map[key] = value;
+        std_map[key] = value;
+        break;
+      }
+
+      case 3: {
+        std::vector<std::pair<int, int> > values;
+        for (size_t j = 0; j < 8; ++j)
+          values.push_back(std::make_pair(rng(200), rng(1000)));
+        flat_map.insert(values.begin(), values.end());
+        std_map.insert(values.begin(), values.end());
+        break;
+      }
+    }
+
+    ASSERT_TRUE(MapsEqual(flat_map, std_map));
+  }
+}
+
+TEST(FlatSetTest, InsertFindErase) {
+  IntFlatSet set;
+  EXPECT_TRUE(set.insert(3).second);
+  EXPECT_TRUE(set.insert(1).second);
+  EXPECT_TRUE(set.insert(2).second);
+  EXPECT_FALSE(set.insert(2).second);
+  EXPECT_EQ(3u, set.size());
+
+  std::vector<int> more;
+  more.push_back(0);
+  more.push_back(3);
+  more.push_back(0);
+  set.insert(more.begin(), more.end());
+  EXPECT_EQ(4u, set.size());
+
+  std::set<int> expected;
+  for (int i = 0; i < 4; ++i)
+    expected.insert(i);
+  EXPECT_TRUE(std::equal(set.begin(), set.end(), expected.begin()));
+
+  EXPECT_TRUE(set.find(2) != set.end());
+  EXPECT_EQ(1u, set.erase(2));
+  EXPECT_TRUE(set.find(2) == set.end());
+  EXPECT_EQ(3u, set.size());
+}
+
+}  // namespace core
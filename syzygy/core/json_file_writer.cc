@@ -18,9 +18,15 @@
 // of thumb is that when output is produced we write as much as is possible.
 #include "syzygy/core/json_file_writer.h"
 
+#include <float.h>
 #include <stdarg.h>
+#include <stdlib.h>
+
+#include <algorithm>
 
 #include "base/logging.h"
+#include "base/string_util.h"
+#include "base/stringprintf.h"
 #include "base/utf_string_conversions.h"
 #include "base/values.h"
 #include "base/json/json_writer.h"
@@ -31,8 +37,13 @@ namespace core {
 
 namespace {
 
+// The size of the output buffer. Output is written to the file in pieces of
+// about this size.
+static const size_t kBufferSize = 64 * 1024;
+
 static const char kNewline[] = "\n";
 static const char kIndent[] = "  ";
+static const char kIndentSpaces[] = "                                ";
 static const char kNull[] = "null";
 static const char kTrue[] = "true";
 static const char kFalse[] = "false";
@@ -41,6 +52,49 @@ static const char kCommentPrefix[] = "//";
 static const char* kStructureOpenings[] = { "[", "{", NULL };
 static const char* kStructureClosings[] = { "]", "}", NULL };
 
+// Formats an integer in decimal.
+// @param value the integer to format.
+// @param buffer receives the digits. Must be at least 11 characters long.
+// @returns the number of characters written to @p buffer.
+size_t FormatInteger(int value, char* buffer) {
+  DCHECK(buffer != NULL);
+
+  // Work on the magnitude as an unsigned value so that INT_MIN is handled.
+  uint32 magnitude = static_cast<uint32>(value);
+  if (value < 0)
+    magnitude = 0 - magnitude;
+
+  // Produce the digits backwards, then copy them out.
+  char digits[10];
+  size_t digit_count = 0;
+  do {
+    digits[digit_count++] = static_cast<char>('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude != 0);
+
+  size_t length = 0;
+  if (value < 0)
+    buffer[length++] = '-';
+  while (digit_count > 0)
+    buffer[length++] = digits[--digit_count];
+
+  return length;
+}
+
+// Determines whether a string may be written out as is between quotes. This
+// is conservative: anything that base::GetDoubleQuotedJson might escape is
+// rejected.
+// @param value the string to check.
+// @returns true if @p value requires no escaping.
+bool IsPlainJsonString(const base::StringPiece& value) {
+  for (size_t i = 0; i < value.length(); ++i) {
+    char c = value[i];
+    if (c < 0x20 || c > 0x7E || c == '"' || c == '\\' || c == '<')
+      return false;
+  }
+  return true;
+}
+
 }  // namespace
 
 struct JSONFileWriter::Helper {
@@ -54,8 +108,7 @@ struct JSONFileWriter::Helper {
     if (!json_file_writer->AlignForValueOrKey())
       return false;
 
-    std::string formatted_key = base::GetDoubleQuotedJson(key.as_string());
-    if (!json_file_writer->Printf("%s:", formatted_key.c_str()))
+    if (!PrintKey(key, json_file_writer) || !json_file_writer->PutChar(':'))
       return false;
 
     // If we're pretty printing, then also output a space between the key and
@@ -68,6 +121,17 @@ struct JSONFileWriter::Helper {
     return true;
   }
 
+  static bool PrintKey(const base::StringPiece& key,
+                       JSONFileWriter* json_file_writer) {
+    return json_file_writer->PrintString(key);
+  }
+
+  static bool PrintKey(const base::StringPiece16& key,
+                       JSONFileWriter* json_file_writer) {
+    std::string formatted_key = base::GetDoubleQuotedJson(key.as_string());
+    return json_file_writer->Write(formatted_key.data(), formatted_key.size());
+  }
+
   template<typename ValueType, typename PrintFunctionPointer>
   static bool OutputValue(ValueType value,
                           PrintFunctionPointer print_function,
@@ -82,6 +146,10 @@ struct JSONFileWriter::Helper {
     if (!(json_file_writer->*print_function)(value))
       return false;
     json_file_writer->FlushValue(true);
+
+    // A complete value goes straight out to the file.
+    if (json_file_writer->finished_)
+      return json_file_writer->WriteBuffer();
     return true;
   }
 };
@@ -93,10 +161,14 @@ JSONFileWriter::JSONFileWriter(FILE* file, bool pretty_print)
       at_col_zero_(true),
       indent_depth_(0) {
   DCHECK(file != NULL);
+  buffer_.reserve(kBufferSize);
 }
 
 JSONFileWriter::~JSONFileWriter() {
   Flush();
+
+  // Don't lose the output of an incomplete value.
+  WriteBuffer();
 }
 
 bool JSONFileWriter::OutputComment(const base::StringPiece& comment) {
@@ -179,24 +251,58 @@ bool JSONFileWriter::OutputTrailingComment(const base::StringPiece16& comment) {
 }
 
 bool JSONFileWriter::PrintBoolean(bool value) {
-  return Printf("%s", value ? kTrue : kFalse);
+  if (value)
+    return Write(kTrue, arraysize(kTrue) - 1);
+  return Write(kFalse, arraysize(kFalse) - 1);
 }
 
 bool JSONFileWriter::PrintInteger(int value) {
-  return Printf("%d", value);
+  char buffer[16];
+  size_t length = FormatInteger(value, buffer);
+  return Write(buffer, length);
 }
 
 bool JSONFileWriter::PrintDouble(double value) {
-  base::FundamentalValue fundamental_value(value);
-  return PrintValue(&fundamental_value);
+  // Leave the values without a JSON representation to base::JSONWriter.
+  if (!_finite(value)) {
+    base::FundamentalValue fundamental_value(value);
+    return PrintValue(&fundamental_value);
+  }
+
+  // Use the shortest precision that reads back as the same value.
+  char buffer[32];
+  int length = base::snprintf(buffer, sizeof(buffer), "%.15g", value);
+  if (length <= 0)
+    return false;
+  if (::strtod(buffer, NULL) != value) {
+    length = base::snprintf(buffer, sizeof(buffer), "%.17g", value);
+    if (length <= 0)
+      return false;
+  }
+
+  // As base::JSONWriter does, make sure that the number reads back as a real
+  // rather than an integer.
+  if (::strpbrk(buffer, ".eE") == NULL) {
+    DCHECK_LT(static_cast<size_t>(length) + 2, sizeof(buffer));
+    buffer[length++] = '.';
+    buffer[length++] = '0';
+  }
+
+  return Write(buffer, length);
 }
 
 bool JSONFileWriter::PrintString(const base::StringPiece& value) {
-  return Printf("%s", base::GetDoubleQuotedJson(value.as_string()).c_str());
+  if (IsPlainJsonString(value)) {
+    return PutChar('"') && Write(value.data(), value.length()) &&
+        PutChar('"');
+  }
+
+  std::string quoted = base::GetDoubleQuotedJson(value.as_string());
+  return Write(quoted.data(), quoted.size());
 }
 
 bool JSONFileWriter::PrintNull(int value_unused) {
-  return Printf("%s", kNull);
+  return Write(kNull, arraysize(kNull) - 1);
 }
 
 bool JSONFileWriter::PrintValue(const base::Value* value) {
@@ -219,7 +325,7 @@ bool JSONFileWriter::PrintValue(const base::Value* value) {
     case Value::TYPE_BINARY: {
       std::string str;
       base::JSONWriter::Write(value, &str);
-      return Printf("%s", str.c_str());
+      return Write(str.data(), str.size());
     }
 
     default: {
@@ -230,22 +336,54 @@ bool JSONFileWriter::PrintValue(const base::Value* value) {
 }
 
 bool JSONFileWriter::Printf(const char* format, ...) {
+  std::string formatted;
   va_list args;
   va_start(args, format);
-  int chars_written = vfprintf(file_, format, args);
+  base::StringAppendV(&formatted, format, args);
   va_end(args);
-  if (chars_written > 0)
-    at_col_zero_ = false;
-  return chars_written >= 0;
+  return Write(formatted.data(), formatted.size());
 }
 
 bool JSONFileWriter::PutChar(char c) {
-  if (fputc(c, file_) != c)
-    return false;
+  return Write(&c, 1);
+}
+
+bool JSONFileWriter::Write(const char* data, size_t length) {
+  DCHECK(data != NULL || length == 0);
+
+  if (length == 0)
+    return true;
   at_col_zero_ = false;
+
+  if (buffer_.size() + length > kBufferSize) {
+    if (!WriteBuffer())
+      return false;
+
+    // Don't bother copying writes which wouldn't fit in the buffer anyway.
+    if (length >= kBufferSize)
+      return ::fwrite(data, 1, length, file_) == length;
+  }
+
+  buffer_.append(data, length);
+
+  // Once the value is complete only comments may follow. These go straight
+  // out, as there may not be an explicit flush.
+  if (finished_)
+    return WriteBuffer();
+
   return true;
 }
 
+bool JSONFileWriter::WriteBuffer() {
+  if (buffer_.empty())
+    return true;
+
+  size_t written = ::fwrite(buffer_.data(), 1, buffer_.size(), file_);
+  bool success = written == buffer_.size();
+  buffer_.clear();
+  return success;
+}
+
 bool JSONFileWriter::OpenList() {
   return OpenStructure(kList);
 }
@@ -271,7 +409,7 @@ bool JSONFileWriter::OutputKey(const base::StringPiece16& key) {
 }
 
 bool JSONFileWriter::Flush() {
-  // Already finished? This is a no-op.
+  // Already finished? Then the output has already been written.
   if (finished_)
     return true;
 
@@ -330,12 +468,14 @@ bool JSONFileWriter::OutputIndent() {
   if (!pretty_print_)
     return true;
 
-  // We bypass Printf and manually update at_col_zero_ here for efficiency.
-  if (indent_depth_ > 0)
-    at_col_zero_ = false;
-  for (size_t i = 0; i < indent_depth_; ++i) {
-    if (fprintf(file_, "%s", kIndent) < 0)
+  // Write the spaces in as few pieces as possible.
+  const size_t kMaxSpaces = arraysize(kIndentSpaces) - 1;
+  size_t spaces = indent_depth_ * (arraysize(kIndent) - 1);
+  while (spaces > 0) {
+    size_t length = std::min(spaces, kMaxSpaces);
+    if (!Write(kIndentSpaces, length))
       return false;
+    spaces -= length;
   }
   return true;
 }
@@ -344,8 +484,7 @@ bool JSONFileWriter::OutputNewline() {
   if (!pretty_print_ || at_col_zero_)
     return true;
 
-  // Bypass Printf and manually at_col_zero_ for efficiency.
-  if (fprintf(file_, "%s", kNewline) < 0)
+  if (!Write(kNewline, arraysize(kNewline) - 1))
     return false;
   at_col_zero_ = true;
 
@@ -471,7 +610,7 @@ bool JSONFileWriter::OpenStructure(StructureType type) {
 
   if (!ReadyForValue() ||
       !AlignForValueOrKey() ||
-      !Printf("%s", kStructureOpenings[type])) {
+      !PutChar(kStructureOpenings[type][0])) {
     return false;
   }
 
@@ -501,13 +640,15 @@ bool JSONFileWriter::CloseStructure(StructureType type) {
   if (pretty_print_ && !OutputIndent())
     return false;
 
-  if (!Printf("%s", kStructureClosings[type])) {
+  if (!PutChar(kStructureClosings[type][0])) {
     return false;
   }
 
   // If this closed the last open structure, then the JSON file is finished.
-  if (stack_.empty())
+  if (stack_.empty()) {
     finished_ = true;
+    return WriteBuffer();
+  }
 
   return true;
 }
@@ -32,6 +32,12 @@ namespace core {
 // Class allowing std::ostream like output for formatted JSON serialization.
 // Doesn't force use of Value or std::string intermediaries like JSONWriter
 // does.
+//
+// The output is accumulated in a large internal buffer. It is written to the
+// file when the buffer fills up, as soon as the JSON value is complete, on
+// Flush and on destruction. When not pretty printing no white-space or
+// comments are produced at all, which is the fastest way to write large
+// outputs.
 class JSONFileWriter {
  public:
   explicit JSONFileWriter(FILE* file, bool pretty_print);
@@ -124,11 +130,15 @@ class JSONFileWriter {
   bool PrintNull(int value_unused);
   bool PrintValue(const base::Value* value);
 
-  // The following group of functions act as pass-through for fprintf and fputc,
-  // but update internal state. No newline characters should be written using
-  // this mechanism. All newlines should be written using OutputNewline.
+  // The following group of functions append to the output buffer and update
+  // internal state. No newline characters should be written using this
+  // mechanism. All newlines should be written using OutputNewline.
   bool Printf(const char* format, ...);
   bool PutChar(char c);
+  bool Write(const char* data, size_t length);
+
+  // Writes the contents of the output buffer to the file.
+  bool WriteBuffer();
 
   // Some state determination functions.
   bool FirstEntry() const;
@@ -148,6 +158,8 @@ class JSONFileWriter {
 
   // The file that is being written to.
   FILE* file_;
+  // The output that has yet to be written to the file.
+  std::string buffer_;
   // Indicates whether or not we are pretty printing.
   bool pretty_print_;
   // This is set when the stream writer is finished. That is, a single value
@@ -16,6 +16,7 @@
 
 #include "base/file_util.h"
 #include "base/logging.h"
+#include "base/string_number_conversions.h"
 #include "base/utf_string_conversions.h"
 #include "base/files/scoped_temp_dir.h"
 #include "gmock/gmock.h"
@@ -538,4 +539,66 @@ TEST_F(JSONFileWriterTest, TrailingCommentSingleValue) {
   ASSERT_EQ(expected, s);
 }
 
+TEST_F(JSONFileWriterTest, OutputIntegers) {
+  TestJSONFileWriter json_file(file(), false);
+  EXPECT_TRUE(json_file.OpenList());
+  EXPECT_TRUE(json_file.OutputInteger(0));
+  EXPECT_TRUE(json_file.OutputInteger(-7));
+  EXPECT_TRUE(json_file.OutputInteger(1234567));
+  EXPECT_TRUE(json_file.OutputInteger(kint32max));
+  EXPECT_TRUE(json_file.OutputInteger(kint32min));
+  EXPECT_TRUE(json_file.CloseList());
+
+  std::string s;
+  ASSERT_TRUE(FileContents(&s));
+  ASSERT_EQ("[0,-7,1234567,2147483647,-2147483648]", s);
+}
+
+TEST_F(JSONFileWriterTest, OutputDoubles) {
+  TestJSONFileWriter json_file(file(), false);
+  EXPECT_TRUE(json_file.OpenList());
+  EXPECT_TRUE(json_file.OutputDouble(2.0));
+  EXPECT_TRUE(json_file.OutputDouble(-0.25));
+  EXPECT_TRUE(json_file.OutputDouble(0.1));
+  EXPECT_TRUE(json_file.OutputDouble(1.0 / 3.0));
+  EXPECT_TRUE(json_file.CloseList());
+
+  std::string s;
+  ASSERT_TRUE(FileContents(&s));
+  ASSERT_EQ("[2.0,-0.25,0.1,0.33333333333333331]", s);
+}
+
+TEST_F(JSONFileWriterTest, OutputEscapedString) {
+  TestJSONFileWriter json_file(file(), false);
+  EXPECT_TRUE(json_file.OpenDict());
+  EXPECT_TRUE(json_file.OutputKey("a\"b"));
+  EXPECT_TRUE(json_file.OutputString("c\\d"));
+  EXPECT_TRUE(json_file.CloseDict());
+
+  std::string s;
+  ASSERT_TRUE(FileContents(&s));
+  ASSERT_EQ("{\"a\\\"b\":\"c\\\\d\"}", s);
+}
+
+TEST_F(JSONFileWriterTest, OutputLargerThanBuffer) {
+  const int kValueCount = 100000;
+  std::string expected("[");
+  {
+    TestJSONFileWriter json_file(file(), false);
+    EXPECT_TRUE(json_file.OpenList());
+    for (int i = 0; i < kValueCount; ++i) {
+      EXPECT_TRUE(json_file.OutputInteger(i));
+      if (i != 0)
+        expected.append(",");
+      expected.append(base::IntToString(i));
+    }
+    EXPECT_TRUE(json_file.CloseList());
+  }
+  expected.append("]");
+
+  std::string s;
+  ASSERT_TRUE(FileContents(&s));
+  ASSERT_EQ(expected, s);
+}
+
 }  // namespace core
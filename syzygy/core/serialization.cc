@@ -56,6 +56,106 @@ bool FileInStream::ReadImpl(size_t length, Byte* bytes, size_t* bytes_read) {
   return true;
 }
 
+BufferedOutStream::BufferedOutStream(OutStream* out_stream)
+    : out_stream_(out_stream), buffer_size_(kDefaultBufferSize) {
+  DCHECK(out_stream != NULL);
+  buffer_.reserve(buffer_size_);
+}
+
+BufferedOutStream::BufferedOutStream(OutStream* out_stream,
+                                     size_t buffer_size)
+    : out_stream_(out_stream), buffer_size_(buffer_size) {
+  DCHECK(out_stream != NULL);
+  DCHECK_LT(0u, buffer_size);
+  buffer_.reserve(buffer_size_);
+}
+
+BufferedOutStream::~BufferedOutStream() {
+  if (!WriteBuffer())
+    LOG(ERROR) << "Unable to write out the buffered data.";
+}
+
+bool BufferedOutStream::Write(size_t length, const Byte* bytes) {
+  DCHECK(bytes != NULL || length == 0);
+
+  if (buffer_.size() + length > buffer_size_) {
+    if (!WriteBuffer())
+      return false;
+
+    // Don't bother copying writes which wouldn't fit in the buffer anyway.
+    if (length >= buffer_size_)
+      return out_stream_->Write(length, bytes);
+  }
+
+  buffer_.insert(buffer_.end(), bytes, bytes + length);
+  return true;
+}
+
+bool BufferedOutStream::Flush() {
+  return WriteBuffer() && out_stream_->Flush();
+}
+
+bool BufferedOutStream::WriteBuffer() {
+  if (buffer_.empty())
+    return true;
+
+  bool written = out_stream_->Write(buffer_.size(), &buffer_[0]);
+  buffer_.clear();
+  return written;
+}
+
+BufferedInStream::BufferedInStream(InStream* in_stream)
+    : in_stream_(in_stream), buffer_size_(kDefaultBufferSize), cursor_(0) {
+  DCHECK(in_stream != NULL);
+}
+
+BufferedInStream::BufferedInStream(InStream* in_stream, size_t buffer_size)
+    : in_stream_(in_stream), buffer_size_(buffer_size), cursor_(0) {
+  DCHECK(in_stream != NULL);
+  DCHECK_LT(0u, buffer_size);
+}
+
+bool BufferedInStream::ReadImpl(size_t length,
+                                Byte* bytes,
+                                size_t* bytes_read) {
+  DCHECK(bytes != NULL || length == 0);
+  DCHECK(bytes_read != NULL);
+
+  *bytes_read = 0;
+  while (length > 0) {
+    if (cursor_ == buffer_.size()) {
+      // Reads which wouldn't fit in the buffer go straight through.
+      if (length >= buffer_size_) {
+        size_t direct_read = 0;
+        if (!in_stream_->Read(length, bytes, &direct_read))
+          return false;
+        *bytes_read += direct_read;
+        return true;
+      }
+
+      // Refill the buffer. A short read means the end of the stream.
+      buffer_.resize(buffer_size_);
+      size_t buffered = 0;
+      bool read = in_stream_->Read(buffer_size_, &buffer_[0], &buffered);
+      buffer_.resize(read ? buffered : 0);
+      cursor_ = 0;
+      if (!read)
+        return false;
+      if (buffered == 0)
+        return true;
+    }
+
+    size_t count = std::min(length, buffer_.size() - cursor_);
+    ::memcpy(bytes, &buffer_[cursor_], count);
+    cursor_ += count;
+    bytes += count;
+    length -= count;
+    *bytes_read += count;
+  }
+
+  return true;
+}
+
 // Serialization of base::Time.
 // We serialize to 'number of seconds since epoch' (represented as a double)
 // as this is consistent regardless of the underlying representation used in
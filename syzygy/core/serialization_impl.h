@@ -50,6 +50,31 @@ template<typename T> struct IsByteLike {
   };
 };
 
+// This tests whether contiguous values of a given type may be serialized in
+// bulk. This holds for the primitive types handled directly by the archives,
+// except bool as std::vector<bool> isn't contiguous.
+template<typename T> struct IsBulkSerializable {
+  enum { Value = 0 };
+};
+#define DECLARE_BULK_SERIALIZABLE(Type) \
+  template<> struct IsBulkSerializable<Type> { \
+    enum { Value = 1 }; \
+  }
+DECLARE_BULK_SERIALIZABLE(char);
+DECLARE_BULK_SERIALIZABLE(wchar_t);
+DECLARE_BULK_SERIALIZABLE(float);
+DECLARE_BULK_SERIALIZABLE(double);
+DECLARE_BULK_SERIALIZABLE(int8);
+DECLARE_BULK_SERIALIZABLE(int16);
+DECLARE_BULK_SERIALIZABLE(int32);
+DECLARE_BULK_SERIALIZABLE(int64);
+DECLARE_BULK_SERIALIZABLE(uint8);
+DECLARE_BULK_SERIALIZABLE(uint16);
+DECLARE_BULK_SERIALIZABLE(uint32);
+DECLARE_BULK_SERIALIZABLE(uint64);
+DECLARE_BULK_SERIALIZABLE(unsigned long);
+#undef DECLARE_BULK_SERIALIZABLE
+
 // This compares two iterators. It only does so if the iterator type is
 // not an output iterator.
 template<typename IteratorTag> struct IteratorsAreEqualFunctor {
@@ -149,6 +174,91 @@ bool LoadContainer(Container* container,
   return true;
 }
 
+// Serialization for arrays and contiguous containers (vector and basic_string)
+// of values. This is specialized on whether the values may be serialized in
+// bulk, in which case they are handed to the archive in a single go.
+template<bool kBulk> struct ContiguousSerializer {
+  template<typename Data, class OutArchive>
+  static bool SaveArray(const Data* values, size_t count,
+                        OutArchive* out_archive) {
+    DCHECK(out_archive != NULL);
+    for (size_t i = 0; i < count; ++i) {
+      if (!out_archive->Save(values[i]))
+        return false;
+    }
+    return true;
+  }
+
+  template<typename Data, class InArchive>
+  static bool LoadArray(Data* values, size_t count, InArchive* in_archive) {
+    DCHECK(in_archive != NULL);
+    for (size_t i = 0; i < count; ++i) {
+      if (!in_archive->Load(&values[i]))
+        return false;
+    }
+    return true;
+  }
+
+  template<class Container, class OutArchive>
+  static bool SaveContainer(const Container& container,
+                            OutArchive* out_archive) {
+    return internal::SaveContainer(container, out_archive);
+  }
+
+  template<class Container, class InArchive>
+  static bool LoadContainer(Container* container, InArchive* in_archive) {
+    DCHECK(container != NULL);
+    return internal::LoadContainer(container,
+                                   std::back_inserter(*container),
+                                   in_archive);
+  }
+};
+template<> struct ContiguousSerializer<true> {
+  template<typename Data, class OutArchive>
+  static bool SaveArray(const Data* values, size_t count,
+                        OutArchive* out_archive) {
+    DCHECK(out_archive != NULL);
+    if (count == 0)
+      return true;
+    return out_archive->SavePrimitiveArray(values, count);
+  }
+
+  template<typename Data, class InArchive>
+  static bool LoadArray(Data* values, size_t count, InArchive* in_archive) {
+    DCHECK(in_archive != NULL);
+    if (count == 0)
+      return true;
+    return in_archive->LoadPrimitiveArray(values, count);
+  }
+
+  template<class Container, class OutArchive>
+  static bool SaveContainer(const Container& container,
+                            OutArchive* out_archive) {
+    DCHECK(out_archive != NULL);
+    if (!out_archive->Save(container.size()))
+      return false;
+    if (container.empty())
+      return true;
+    return SaveArray(&container[0], container.size(), out_archive);
+  }
+
+  template<class Container, class InArchive>
+  static bool LoadContainer(Container* container, InArchive* in_archive) {
+    DCHECK(container != NULL);
+    DCHECK(in_archive != NULL);
+
+    typename Container::size_type size = 0;
+    if (!in_archive->Load(&size))
+      return false;
+
+    container->clear();
+    container->resize(size);
+    if (size == 0)
+      return true;
+    return LoadArray(&(*container)[0], size, in_archive);
+  }
+};
+
 }  // namespace internal
 
 template<typename OutputIterator> bool ByteOutStream<OutputIterator>::Write(
@@ -204,7 +314,9 @@ template<typename Char, typename Traits, typename Alloc, class OutArchive>
 bool Save(const std::basic_string<Char, Traits, Alloc>& string,
           OutArchive* out_archive) {
   DCHECK(out_archive != NULL);
-  return internal::SaveContainer(string, out_archive);
+  return internal::ContiguousSerializer<
+      internal::IsBulkSerializable<Char>::Value>::SaveContainer(string,
+                                                                out_archive);
 }
 
 template<typename Key, typename Data, typename Compare, typename Alloc,
@@ -233,7 +345,9 @@ template<typename Type, typename Alloc, class OutArchive>
 bool Save(const std::vector<Type, Alloc>& vector,
           OutArchive* out_archive) {
   DCHECK(out_archive != NULL);
-  return internal::SaveContainer(vector, out_archive);
+  return internal::ContiguousSerializer<
+      internal::IsBulkSerializable<Type>::Value>::SaveContainer(vector,
+                                                                out_archive);
 }
 
 // Implementation of STL Load specializations.
@@ -244,9 +358,9 @@ bool Load(std::basic_string<Char, Traits, Alloc>* string,
   DCHECK(string != NULL);
   DCHECK(in_archive != NULL);
   string->clear();
-  return internal::LoadContainer(string,
-                                 std::back_inserter(*string),
-                                 in_archive);
+  return internal::ContiguousSerializer<
+      internal::IsBulkSerializable<Char>::Value>::LoadContainer(string,
+                                                                in_archive);
 }
 
 template<typename Key, typename Data, typename Compare, typename Alloc,
@@ -285,9 +399,9 @@ bool Load(std::vector<Type, Alloc>* vector,
           InArchive* in_archive) {
   DCHECK(vector != NULL);
   DCHECK(in_archive != NULL);
-  return internal::LoadContainer(vector,
-                                 std::back_inserter(*vector),
-                                 in_archive);
+  return internal::ContiguousSerializer<
+      internal::IsBulkSerializable<Type>::Value>::LoadContainer(vector,
+                                                                in_archive);
 }
 
 // Implementation of serialization for C-style arrays.
@@ -295,22 +409,18 @@ bool Load(std::vector<Type, Alloc>* vector,
 template<typename Type, size_t Length, class OutArchive>
 bool Save(const Type (&data)[Length], OutArchive* out_archive) {
   DCHECK(out_archive != NULL);
-  for (size_t i = 0; i < Length; ++i) {
-    if (!out_archive->Save(data[i]))
-      return false;
-  }
-  return true;
+  return internal::ContiguousSerializer<
+      internal::IsBulkSerializable<Type>::Value>::SaveArray(data, Length,
+                                                            out_archive);
 }
 
 template<typename Type, size_t Length, class InArchive>
 bool Load(Type (*data)[Length], InArchive* in_archive) {
   DCHECK(data != NULL);
   DCHECK(in_archive != NULL);
-  for (size_t i = 0; i < Length; ++i) {
-    if (!in_archive->Load(&((*data)[i])))
-      return false;
-  }
-  return true;
+  return internal::ContiguousSerializer<
+      internal::IsBulkSerializable<Type>::Value>::LoadArray(*data, Length,
+                                                            in_archive);
 }
 
 // Declaration of serialization for base::Time.
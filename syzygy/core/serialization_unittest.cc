@@ -153,6 +153,97 @@ TEST_F(SerializationTest, FileInStream) {
   EXPECT_FALSE(in_stream.Read(sizeof(kTestData), buffer));
 }
 
+TEST_F(SerializationTest, BufferedOutStream) {
+  ByteVector bytes;
+  ScopedOutStreamPtr byte_stream;
+  byte_stream.reset(CreateByteOutStream(std::back_inserter(bytes)));
+
+  {
+    BufferedOutStream out_stream(byte_stream.get(), 4);
+
+    // Small writes are held back until the buffer fills up.
+    EXPECT_TRUE(out_stream.Write(2, kTestData));
+    EXPECT_TRUE(bytes.empty());
+    EXPECT_TRUE(out_stream.Write(2, kTestData + 2));
+    EXPECT_TRUE(bytes.empty());
+    EXPECT_TRUE(out_stream.Write(1, kTestData + 4));
+    EXPECT_EQ(4u, bytes.size());
+
+    // Large writes go straight through, after the buffered data.
+    EXPECT_TRUE(out_stream.Write(8, kTestData + 5));
+    EXPECT_EQ(13u, bytes.size());
+
+    // The rest is written out on destruction.
+    EXPECT_TRUE(out_stream.Write(sizeof(kTestData) - 13, kTestData + 13));
+  }
+
+  EXPECT_EQ(sizeof(kTestData), bytes.size());
+  EXPECT_EQ(0, memcmp(&bytes[0], kTestData, sizeof(kTestData)));
+}
+
+TEST_F(SerializationTest, BufferedInStream) {
+  ByteVector bytes(kTestData, kTestData + sizeof(kTestData));
+  ScopedInStreamPtr byte_stream;
+  byte_stream.reset(CreateByteInStream(bytes.begin(), bytes.end()));
+  BufferedInStream in_stream(byte_stream.get(), 4);
+
+  // Reads smaller and larger than the buffer, spanning refills.
+  Byte buffer[sizeof(kTestData)];
+  EXPECT_TRUE(in_stream.Read(3, buffer));
+  EXPECT_TRUE(in_stream.Read(2, buffer + 3));
+  EXPECT_TRUE(in_stream.Read(9, buffer + 5));
+  EXPECT_TRUE(in_stream.Read(sizeof(kTestData) - 14, buffer + 14));
+  EXPECT_EQ(0, memcmp(buffer, kTestData, sizeof(kTestData)));
+
+  // We should not be able to read past the end of the stream.
+  size_t bytes_read = 0;
+  EXPECT_TRUE(in_stream.Read(1, buffer, &bytes_read));
+  EXPECT_EQ(0u, bytes_read);
+  EXPECT_FALSE(in_stream.Read(1, buffer));
+}
+
+TEST_F(SerializationTest, BulkSerializationMatchesElementWise) {
+  std::vector<uint32> vector;
+  for (uint32 i = 0; i < 100; ++i)
+    vector.push_back(i * 7);
+
+  // Save the vector, and the same values one at a time.
+  ByteVector bulk_bytes;
+  ScopedOutStreamPtr bulk_stream;
+  bulk_stream.reset(CreateByteOutStream(std::back_inserter(bulk_bytes)));
+  NativeBinaryOutArchive bulk_archive(bulk_stream.get());
+  EXPECT_TRUE(bulk_archive.Save(vector));
+
+  ByteVector element_bytes;
+  ScopedOutStreamPtr element_stream;
+  element_stream.reset(CreateByteOutStream(std::back_inserter(element_bytes)));
+  NativeBinaryOutArchive element_archive(element_stream.get());
+  EXPECT_TRUE(element_archive.Save(vector.size()));
+  for (size_t i = 0; i < vector.size(); ++i)
+    EXPECT_TRUE(element_archive.Save(vector[i]));
+
+  EXPECT_EQ(element_bytes, bulk_bytes);
+}
+
+TEST_F(SerializationTest, ContiguousTypesRoundTrip) {
+  EXPECT_TRUE(TestRoundTrip(std::string()));
+  EXPECT_TRUE(TestRoundTrip(std::vector<double>()));
+
+  std::vector<bool> bools;
+  bools.push_back(true);
+  bools.push_back(false);
+  EXPECT_TRUE(TestRoundTrip(bools));
+
+  std::vector<std::string> strings;
+  strings.push_back("foo");
+  strings.push_back("");
+  strings.push_back("bar");
+  EXPECT_TRUE(TestRoundTrip(strings));
+
+  std::vector<int64> int64s(1000, -1);
+  EXPECT_TRUE(TestRoundTrip(int64s));
+}
+
 TEST_F(SerializationTest, PlainOldDataTypesRoundTrip) {
   EXPECT_TRUE(TestRoundTrip<bool>(true));
   EXPECT_TRUE(TestRoundTrip<char>('c'));
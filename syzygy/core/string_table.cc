@@ -15,11 +15,30 @@
 
 #include "syzygy/core/string_table.h"
 
+#include <new>
+
 namespace core {
 
+StringTable::~StringTable() {
+  // The arena doesn't run destructors, and the strings may own a buffer.
+  StringMap::iterator it = string_table_.begin();
+  for (; it != string_table_.end(); ++it) {
+    typedef std::string String;
+    it->second->~String();
+  }
+}
+
 const std::string& StringTable::InternString(const base::StringPiece& str) {
-  std::string value(str.data(), str.size());
-  return *(string_table_.insert(value).first);
+  StringMap::const_iterator it = string_table_.find(str);
+  if (it != string_table_.end())
+    return *it->second;
+
+  // Key the new string by its own contents rather than by @p str, which
+  // may not outlive this call.
+  void* storage = arena_.Allocate(sizeof(std::string));
+  std::string* value = new(storage) std::string(str.data(), str.size());
+  string_table_.insert(std::make_pair(base::StringPiece(*value), value));
+  return *value;
 }
 
 }  // namespace core
@@ -23,15 +23,21 @@
 // const std::string& str2 = strtab.InternString("dummy");
 //
 // str1 and str2 are the same instance of a string holding the value "dummy".
+//
+// The strings are looked up in a hash table keyed by their contents, so
+// interning a string which is already present doesn't allocate, and the
+// interned strings themselves are carved out of an arena rather than
+// allocated as the nodes of a container.
 
 #ifndef SYZYGY_CORE_STRING_TABLE_H_
 #define SYZYGY_CORE_STRING_TABLE_H_
 
-#include <set>
 #include <string>
 
 #include "base/basictypes.h"
+#include "base/hash_tables.h"
 #include "base/string_piece.h"
+#include "syzygy/core/arena.h"
 
 namespace core {
 
@@ -41,6 +47,9 @@ class StringTable {
   StringTable() {
   }
 
+  // Destroys the interned strings.
+  ~StringTable();
+
   // A pool of strings is maintained privately. If the pool already contains a
   // string equal to @p str, then the string from the pool is returned.
   // Otherwise, the string is added to the pool and a reference is returned.
@@ -48,8 +57,17 @@ class StringTable {
   // @returns a canonical representation for this string.
   const std::string& InternString(const base::StringPiece& str);
 
+  // @returns the number of interned strings.
+  size_t size() const { return string_table_.size(); }
+
  protected:
-  std::set<std::string> string_table_;
+  // The interned strings, keyed by their contents. The keys point into the
+  // strings they map to, which never move nor change.
+  typedef base::hash_map<base::StringPiece, const std::string*> StringMap;
+  StringMap string_table_;
+
+  // The arena the interned strings are allocated from.
+  Arena arena_;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(StringTable);
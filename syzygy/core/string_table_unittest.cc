@@ -46,6 +46,7 @@ TEST(StringTableTest, InternString) {
 
   // Validate the size of the internal strings pool.
   EXPECT_EQ(3U, strtab.string_table_.size());
+  EXPECT_EQ(3U, strtab.size());
 
   // Validate string sharing.
   EXPECT_FALSE(str1.c_str() == str2.c_str());
@@ -54,4 +55,30 @@ TEST(StringTableTest, InternString) {
   EXPECT_FALSE(str1.c_str() == str5.c_str());
 }
 
+TEST(StringTableTest, InternedStringsOutliveTheirSource) {
+  TestStringTable strtab;
+
+  const std::string* strings[100] = {};
+  for (size_t i = 0; i < arraysize(strings); ++i) {
+    // The source string goes away right after being interned.
+    std::string source(i + 1, 'a');
+    strings[i] = &strtab.InternString(source);
+    EXPECT_EQ(source, *strings[i]);
+  }
+  EXPECT_EQ(arraysize(strings), strtab.size());
+
+  // Interning the same contents again, from another buffer, yields the same
+  // instances even once the table has grown.
+  for (size_t i = 0; i < arraysize(strings); ++i) {
+    std::string source(i + 1, 'a');
+    EXPECT_EQ(strings[i], &strtab.InternString(source));
+  }
+  EXPECT_EQ(arraysize(strings), strtab.size());
+
+  // The empty string can be interned too.
+  const std::string& empty = strtab.InternString("");
+  EXPECT_TRUE(empty.empty());
+  EXPECT_EQ(&empty, &strtab.InternString(base::StringPiece()));
+}
+
 }  // namespace core
@@ -14,6 +14,12 @@
 
 #include "syzygy/core/zstream.h"
 
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/memory/scoped_vector.h"
+#include "base/threading/simple_thread.h"
+#include "syzygy/core/closure_delegate.h"
 #include "syzygy/core/serialization.h"
 #include "third_party/zlib/zlib.h"
 
@@ -27,6 +33,35 @@ namespace {
 // grow dynamically so we simply use a page of memory.
 static const size_t kZStreamBufferSize = 4096;
 
+// Compresses a chunk of data to a complete zlib stream. This is safe to call
+// from several threads.
+// @param level the level of compression.
+// @param input the data to compress. Must not be empty.
+// @param output receives the compressed data.
+// @param success is set to true on success, false otherwise.
+void CompressChunk(int level,
+                   const std::vector<uint8>* input,
+                   std::vector<uint8>* output,
+                   bool* success) {
+  DCHECK(input != NULL);
+  DCHECK(!input->empty());
+  DCHECK(output != NULL);
+  DCHECK(success != NULL);
+
+  uLongf output_length = compressBound(input->size());
+  output->resize(output_length);
+  int ret = compress2(&output->at(0), &output_length,
+                      &input->at(0), input->size(), level);
+  if (ret != Z_OK) {
+    LOG(ERROR) << "zlib compress2 returned " << ret << ".";
+    *success = false;
+    return;
+  }
+
+  output->resize(output_length);
+  *success = true;
+}
+
 }  // namespace
 
 // Functor that takes care of cleaning up a zstream object that was initialized
@@ -41,7 +76,8 @@ struct ZOutStream::z_stream_s_close {
 };
 
 ZOutStream::ZOutStream(OutStream* out_stream)
-    : out_stream_(out_stream), buffer_(kZStreamBufferSize, 0) {
+    : out_stream_(out_stream), buffer_(kZStreamBufferSize, 0),
+      level_(Z_DEFAULT_COMPRESSION), threads_(0) {
 }
 
 ZOutStream::~ZOutStream() { }
@@ -53,7 +89,7 @@ bool ZOutStream::Init() {
 bool ZOutStream::Init(int level) {
   DCHECK(level == Z_DEFAULT_COMPRESSION || (level >= 0 && level <= 9));
 
-  if (zstream_ != NULL)
+  if (zstream_ != NULL || threads_ > 1)
     return true;
 
   scoped_ptr<z_stream_s> zstream(new z_stream_s);
@@ -74,7 +110,26 @@ bool ZOutStream::Init(int level) {
   return true;
 }
 
+bool ZOutStream::Init(int level, size_t threads) {
+  DCHECK(level == Z_DEFAULT_COMPRESSION || (level >= 0 && level <= 9));
+  DCHECK_LT(0u, threads);
+
+  if (threads <= 1)
+    return Init(level);
+
+  if (zstream_ != NULL || threads_ > 1)
+    return true;
+
+  level_ = level;
+  threads_ = threads;
+
+  return true;
+}
+
 bool ZOutStream::Write(size_t length, const Byte* bytes) {
+  if (threads_ > 1)
+    return WriteChunks(length, bytes);
+
   DCHECK(zstream_.get() != NULL);
   DCHECK_EQ(buffer_.size(), kZStreamBufferSize);
 
@@ -104,6 +159,12 @@ bool ZOutStream::Write(size_t length, const Byte* bytes) {
 }
 
 bool ZOutStream::Flush() {
+  if (threads_ > 1) {
+    bool flushed = FlushChunks();
+    threads_ = 0;
+    return flushed;
+  }
+
   DCHECK(zstream_.get() != NULL);
   DCHECK_EQ(buffer_.size(), kZStreamBufferSize);
 
@@ -146,6 +207,76 @@ bool ZOutStream::FlushBuffer() {
   return true;
 }
 
+bool ZOutStream::WriteChunks(size_t length, const Byte* bytes) {
+  DCHECK_LT(1u, threads_);
+
+  if (length == 0)
+    return true;
+
+  DCHECK(bytes != NULL);
+
+  while (length > 0) {
+    // Start a new chunk once the last one is full. When there are enough full
+    // chunks to keep all of the workers busy they get compressed first.
+    if (chunks_.empty() || chunks_.back().size() == kParallelChunkSize) {
+      if (chunks_.size() == threads_ && !FlushChunks())
+        return false;
+      chunks_.push_back(std::vector<uint8>());
+      chunks_.back().reserve(kParallelChunkSize);
+    }
+
+    std::vector<uint8>& chunk = chunks_.back();
+    size_t chunk_length = std::min(length, kParallelChunkSize - chunk.size());
+    chunk.insert(chunk.end(), bytes, bytes + chunk_length);
+    bytes += chunk_length;
+    length -= chunk_length;
+  }
+
+  return true;
+}
+
+bool ZOutStream::FlushChunks() {
+  DCHECK_LT(1u, threads_);
+
+  if (chunks_.empty())
+    return true;
+
+  // Compress the chunks. Each worker only touches its own chunk.
+  std::vector<std::vector<uint8> > outputs(chunks_.size());
+  scoped_ptr<bool[]> results(new bool[chunks_.size()]);
+  if (chunks_.size() == 1) {
+    CompressChunk(level_, &chunks_[0], &outputs[0], &results[0]);
+  } else {
+    ScopedVector<ClosureDelegate> work;
+    for (size_t i = 0; i < chunks_.size(); ++i) {
+      work.push_back(new ClosureDelegate(
+          base::Bind(&CompressChunk, level_, &chunks_[i], &outputs[i],
+                     &results[i])));
+    }
+
+    base::DelegateSimpleThreadPool pool(
+        "ZOutStream", static_cast<int>(std::min(threads_, work.size())));
+    pool.Start();
+    for (size_t i = 0; i < work.size(); ++i)
+      pool.AddWork(work[i]);
+    pool.JoinAll();
+  }
+
+  // Write out the compressed chunks in order.
+  for (size_t i = 0; i < chunks_.size(); ++i) {
+    if (!results[i])
+      return false;
+    if (!out_stream_->Write(outputs[i].size(), &outputs[i][0])) {
+      LOG(ERROR) << "Unable to write compressed stream.";
+      return false;
+    }
+  }
+
+  chunks_.clear();
+
+  return true;
+}
+
 // Functor that takes care of cleaning up a zstream object that was initialized
 // with inflateInit.
 struct ZInStream::z_stream_s_close {
@@ -202,22 +333,33 @@ bool ZInStream::ReadImpl(size_t length, Byte* bytes, size_t* bytes_read) {
   zstream_->next_out = reinterpret_cast<Bytef*>(bytes);
   zstream_->avail_out = length;
 
-  int ret = Z_OK;
+  bool end_of_stream = false;
   while (true) {
     // Try reading from the zstream right away. It's possible for the input
     // buffer to be exhausted, but for there to still be data to output.
-    ret = inflate(zstream_.get(), Z_NO_FLUSH);
+    int ret = inflate(zstream_.get(), Z_NO_FLUSH);
     if (ret != Z_OK && ret != Z_BUF_ERROR && ret != Z_STREAM_END) {
       LOG(ERROR) << "zlib inflate returned " << ret << ": " << zstream_->msg
                  << ".";
       return false;
     }
 
-    // No more data, or no more room to write more data? Then we're done
-    // for now.
-    if (ret == Z_STREAM_END || zstream_->avail_out == 0)
+    // No more room to write more data? Then we're done for now.
+    if (zstream_->avail_out == 0)
       break;
 
+    // The current zlib stream has ended. Carry on with the next one, if any.
+    if (ret == Z_STREAM_END) {
+      bool found = false;
+      if (!StartNextStream(&found))
+        return false;
+      if (!found) {
+        end_of_stream = true;
+        break;
+      }
+      continue;
+    }
+
     // If we get here, then there was room to output more data yet that wasn't
     // done. Thus, we must need more input.
     if (zstream_->avail_in != 0) {
@@ -243,10 +385,39 @@ bool ZInStream::ReadImpl(size_t length, Byte* bytes, size_t* bytes_read) {
 
   // Is the zstream exhausted? Then we can clean up this stream to indicate
   // end of stream to further calls.
-  if (ret == Z_STREAM_END && zstream_->avail_out == 0)
+  if (end_of_stream)
     zstream_.reset();
 
   return true;
 }
 
+bool ZInStream::StartNextStream(bool* found) {
+  DCHECK(zstream_.get() != NULL);
+  DCHECK(found != NULL);
+
+  *found = false;
+
+  // Make sure there's some input left.
+  if (zstream_->avail_in == 0) {
+    size_t bytes_read = 0;
+    if (!in_stream_->Read(buffer_.size(), &buffer_[0], &bytes_read)) {
+      LOG(ERROR) << "Unable to read data from input stream.";
+      return false;
+    }
+    if (bytes_read == 0)
+      return true;
+    zstream_->next_in = reinterpret_cast<Bytef*>(&buffer_[0]);
+    zstream_->avail_in = bytes_read;
+  }
+
+  int ret = inflateReset(zstream_.get());
+  if (ret != Z_OK) {
+    LOG(ERROR) << "zlib inflateReset returned " << ret << ".";
+    return false;
+  }
+
+  *found = true;
+  return true;
+}
+
 }  // namespace core
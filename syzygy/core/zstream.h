@@ -27,6 +27,12 @@ namespace core {
 // A zlib compressing out-stream. Acts as a filter, accepting the uncompressed
 // input that is pushed to it, and pushing compressed output to the chained
 // stream.
+//
+// In parallel mode the input is cut into fixed-size chunks which are
+// compressed independently on a pool of worker threads. Each chunk produces a
+// complete zlib stream, and these are written back to back in order. This
+// compresses slightly less well, and only a ZInStream (or another reader of
+// concatenated zlib streams) can decompress the output.
 class ZOutStream : public OutStream {
  public:
   // @{
@@ -44,6 +50,9 @@ class ZOutStream : public OutStream {
   static const int kZBestSpeed = 1;
   static const int kZBestCompression = 9;
 
+  // The size of the chunks compressed independently in parallel mode.
+  static const size_t kParallelChunkSize = 1024 * 1024;
+
   // @{
   // Initializes this compressor. Must be called prior to calling Write.
   // @param level the level of compression. Must be kZDefaultCompression (-1),
@@ -54,6 +63,14 @@ class ZOutStream : public OutStream {
   bool Init(int level);
   // @}
 
+  // Initializes this compressor in parallel mode. Must be called prior to
+  // calling Write.
+  // @param level the level of compression, as above.
+  // @param threads the number of worker threads to use. A value of 1 is the
+  //     same as calling Init(level).
+  // @returns true on success, false otherwise.
+  bool Init(int level, size_t threads);
+
   // @name OutStream implementation.
   // @{
   // Writes the given buffer of data to the stream. This may or may not produce
@@ -75,13 +92,30 @@ class ZOutStream : public OutStream {
 
   bool FlushBuffer();
 
+  // @name Parallel mode implementation.
+  // @{
+  bool WriteChunks(size_t length, const Byte* bytes);
+  // Compresses the pending chunks and writes them to the chained stream.
+  bool FlushChunks();
+  // @}
+
   scoped_ptr_malloc<z_stream_s, z_stream_s_close> zstream_;
   OutStream* out_stream_;
   std::vector<uint8> buffer_;
+
+  // The state of the parallel mode. This is only used when threads_ is
+  // greater than 1, in which case zstream_ is unused.
+  int level_;
+  size_t threads_;
+  // The uncompressed chunks waiting to be compressed. Only the last one may
+  // be partially filled.
+  std::vector<std::vector<uint8> > chunks_;
 };
 
 // A zlib decompressing in-stream, decompressing the data from the chained
-// input stream and returning decompressed data to the caller.
+// input stream and returning decompressed data to the caller. Several zlib
+// streams written back to back, such as the output of a ZOutStream in
+// parallel mode, are decompressed as a single stream.
 class ZInStream : public InStream {
  public:
   // Constructor.
@@ -103,6 +137,13 @@ class ZInStream : public InStream {
  private:
   struct z_stream_s_close;
 
+  // Prepares to decompress the zlib stream following the one which has just
+  // ended, if there is one.
+  // @param found is set to true if there is another stream, false if the
+  //     input is exhausted.
+  // @returns true on success, false otherwise.
+  bool StartNextStream(bool* found);
+
   scoped_ptr_malloc<z_stream_s, z_stream_s_close> zstream_;
   InStream* in_stream_;
   std::vector<uint8> buffer_;
@@ -14,6 +14,8 @@
 
 #include "syzygy/core/zstream.h"
 
+#include <algorithm>
+
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/serialization.h"
@@ -133,4 +135,72 @@ TEST(ZStreamTest, RoundTrip) {
   EXPECT_THAT(decompressed, testing::ElementsAreArray(kSampleData));
 }
 
+TEST(ZStreamTest, ConcatenatedStreamsRoundTrip) {
+  std::vector<uint8> compressed;
+  ScopedOutStreamPtr out_stream(
+      CreateByteOutStream(std::back_inserter(compressed)));
+  for (size_t i = 0; i < 2; ++i) {
+    ZOutStream zip_stream(out_stream.get());
+    EXPECT_TRUE(zip_stream.Init());
+    EXPECT_TRUE(zip_stream.Write(sizeof(kSampleData), kSampleData));
+    EXPECT_TRUE(zip_stream.Flush());
+  }
+
+  ScopedInStreamPtr in_stream(
+      CreateByteInStream(compressed.begin(), compressed.end()));
+  ZInStream unzip_stream(in_stream.get());
+  EXPECT_TRUE(unzip_stream.Init());
+
+  // Both streams should be read back as one.
+  std::vector<uint8> decompressed(3 * sizeof(kSampleData));
+  size_t bytes_read = 0;
+  EXPECT_TRUE(unzip_stream.Read(decompressed.size(),
+                                &decompressed[0],
+                                &bytes_read));
+  EXPECT_EQ(2 * sizeof(kSampleData), bytes_read);
+  EXPECT_EQ(0, ::memcmp(&decompressed[0], kSampleData, sizeof(kSampleData)));
+  EXPECT_EQ(0, ::memcmp(&decompressed[sizeof(kSampleData)], kSampleData,
+                        sizeof(kSampleData)));
+}
+
+TEST(ZStreamTest, ParallelRoundTrip) {
+  // Use enough data to fill several batches of chunks, the last of them
+  // partially.
+  std::vector<uint8> data;
+  while (data.size() < 5 * ZOutStream::kParallelChunkSize + 1234)
+    data.insert(data.end(), kSampleData, kSampleData + sizeof(kSampleData));
+  for (size_t i = 0; i < data.size(); i += 7)
+    data[i] = static_cast<uint8>(i);
+
+  std::vector<uint8> compressed;
+  ScopedOutStreamPtr out_stream(
+      CreateByteOutStream(std::back_inserter(compressed)));
+  ZOutStream zip_stream(out_stream.get());
+  EXPECT_TRUE(zip_stream.Init(ZOutStream::kZBestSpeed, 2));
+
+  // Write in uneven pieces so that some of them straddle chunks.
+  const size_t kWriteSize = 100 * 1000;
+  for (size_t i = 0; i < data.size(); i += kWriteSize) {
+    size_t length = std::min(kWriteSize, data.size() - i);
+    EXPECT_TRUE(zip_stream.Write(length, &data[i]));
+  }
+  EXPECT_TRUE(zip_stream.Flush());
+  EXPECT_LT(0u, compressed.size());
+  EXPECT_GT(data.size(), compressed.size());
+
+  ScopedInStreamPtr in_stream(
+      CreateByteInStream(compressed.begin(), compressed.end()));
+  ZInStream unzip_stream(in_stream.get());
+  EXPECT_TRUE(unzip_stream.Init());
+
+  std::vector<uint8> decompressed(data.size() + 1);
+  size_t bytes_read = 0;
+  EXPECT_TRUE(unzip_stream.Read(decompressed.size(),
+                                &decompressed[0],
+                                &bytes_read));
+  EXPECT_EQ(data.size(), bytes_read);
+  decompressed.resize(bytes_read);
+  EXPECT_TRUE(data == decompressed);
+}
+
 }  // namespace core
@@ -19,12 +19,14 @@
 
 #include "syzygy/experimental/code_tally/code_tally.h"
 
+#include <algorithm>
 #include <cstdio>
 
 #include "base/bind.h"
 #include "base/logging.h"
 #include "base/string_util.h"
 #include "base/stringprintf.h"
+#include "base/threading/simple_thread.h"
 #include "base/win/pe_image.h"
 #include "base/win/scoped_com_initializer.h"
 #include "base/win/scoped_bstr.h"
@@ -87,10 +89,279 @@ bool GetImageSignature(const base::FilePath& image_name,
   return true;
 }
 
+// Appends the id of @p symbol to @p ids.
+bool GetSymbolId(std::vector<DWORD>* ids, IDiaSymbol* symbol) {
+  DCHECK(ids != NULL);
+  DCHECK(symbol != NULL);
+
+  DWORD id = 0;
+  HRESULT hr = symbol->get_symIndexId(&id);
+  if (hr != S_OK) {
+    LOG(ERROR) << "Failed to get symbol id: " << com::LogHr(hr);
+    return false;
+  }
+  ids->push_back(id);
+
+  return true;
+}
+
 }  // namespace
 
+// Walks the compilands handed out by a code tally on a worker thread, with
+// its own DIA session, and collects their functions and lines.
+class CodeTally::CompilandWorker : public base::DelegateSimpleThread::Delegate {
+ public:
+  CompilandWorker(CodeTally* tally, const base::FilePath& pdb_file)
+      : tally_(tally), pdb_file_(pdb_file), succeeded_(false) {
+    DCHECK(tally_ != NULL);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  virtual void Run() OVERRIDE;
+  // @}
+
+  bool succeeded() const { return succeeded_; }
+
+ private:
+  // Opens our own DIA session on the PDB file.
+  bool OpenSession();
+
+  // Walks the compiland with index @p index.
+  bool VisitCompiland(size_t index);
+
+  // Callback for function enumeration.
+  bool OnFunction(CompilandInfo* compiland, IDiaSymbol* function);
+
+  // Callback for line enumeration. Records the line's code range in the
+  // function containing it, and updates the use counts of its bytes.
+  bool OnLine(CompilandInfo* compiland, IDiaLineNumber* line_number);
+
+  CodeTally* tally_;
+  base::FilePath pdb_file_;
+  bool succeeded_;
+
+  // The DIA session this worker walks its compilands with.
+  base::win::ScopedComPtr<IDiaSession> session_;
+
+  // The source files referenced by the lines of our compilands.
+  SourceFileInfoMap source_files_;
+
+  DISALLOW_COPY_AND_ASSIGN(CompilandWorker);
+};
+
+void CodeTally::CompilandWorker::Run() {
+  base::win::ScopedCOMInitializer com_initializer;
+
+  if (!OpenSession())
+    return;
+
+  size_t num_compilands = tally_->compiland_ids_.size();
+  for (size_t i = tally_->NextCompiland(); i < num_compilands;
+       i = tally_->NextCompiland()) {
+    if (!VisitCompiland(i))
+      return;
+  }
+
+  succeeded_ = true;
+}
+
+bool CodeTally::CompilandWorker::OpenSession() {
+  base::win::ScopedComPtr<IDiaDataSource> data_source;
+  HRESULT hr = data_source.CreateInstance(CLSID_DiaSource);
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Unable to create DIA source: " << com::LogHr(hr);
+    return false;
+  }
+  hr = data_source->loadDataFromPdb(pdb_file_.value().c_str());
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Unable to load PDB: " << com::LogHr(hr);
+    return false;
+  }
+
+  hr = data_source->openSession(session_.Receive());
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Unable to open session: " << com::LogHr(hr);
+    return false;
+  }
+
+  return true;
+}
+
+bool CodeTally::CompilandWorker::VisitCompiland(size_t index) {
+  DCHECK_LT(index, tally_->compiland_ids_.size());
+
+  base::win::ScopedComPtr<IDiaSymbol> compiland;
+  HRESULT hr = session_->symbolById(tally_->compiland_ids_[index],
+                                    compiland.Receive());
+  if (hr != S_OK) {
+    LOG(ERROR) << "Failed to get compiland: " << com::LogHr(hr);
+    return false;
+  }
+  DCHECK(pe::IsSymTag(compiland, SymTagCompiland));
+
+  base::win::ScopedBstr compiland_name;
+  hr = compiland->get_name(compiland_name.Receive());
+  if (hr != S_OK) {
+    LOG(ERROR) << "Failed to get compiland name: " << com::LogHr(hr);
+    return false;
+  }
+
+  // Each compiland index is handed out once, so no other thread touches
+  // its info.
+  CompilandInfo* info = tally_->compilands_[index];
+  info->object_file = com::ToString(compiland_name);
+
+  pe::ChildVisitor function_visitor(compiland, SymTagFunction);
+  if (!function_visitor.VisitChildren(
+          base::Bind(&CompilandWorker::OnFunction,
+                     base::Unretained(this),
+                     info))) {
+    return false;
+  }
+
+  pe::LineVisitor line_visitor(session_, compiland);
+  return line_visitor.VisitLines(
+      base::Bind(&CompilandWorker::OnLine,
+                 base::Unretained(this),
+                 info));
+}
+
+bool CodeTally::CompilandWorker::OnFunction(CompilandInfo* compiland,
+                                            IDiaSymbol* function) {
+  DCHECK(compiland != NULL);
+  DCHECK(function != NULL);
+
+  DWORD rva = 0;
+  HRESULT hr = function->get_relativeVirtualAddress(&rva);
+  if (hr != S_OK) {
+    LOG(ERROR) << "Failed to get function RVA: " << com::LogHr(hr);
+    return false;
+  }
+
+  ULONGLONG length = 0;
+  hr = function->get_length(&length);
+  if (hr != S_OK || length > MAXINT) {
+    LOG(ERROR) << "Failed to get function length: " << com::LogHr(hr);
+    return false;
+  }
+
+  base::win::ScopedBstr name;
+  hr = function->get_name(name.Receive());
+  if (hr != S_OK) {
+    LOG(ERROR) << "Failed to get function name: " << com::LogHr(hr);
+    return false;
+  }
+
+  FunctionRange range(rva, static_cast<size_t>(length));
+  if (!compiland->functions.Insert(range,
+                                   FunctionInfo(com::ToString(name)))) {
+    FunctionInfoAddressSpace::iterator it =
+        compiland->functions.FindContaining(range);
+    if (it == compiland->functions.end()) {
+      LOG(ERROR) << "Overlapping function info for '"
+                 << com::ToString(name) << "'";
+      return false;
+    } else if (it->first != range) {
+      LOG(ERROR) << "Function '"
+                 << com::ToString(name) << "' partially overlaps function '"
+                 << it->second.name << "' in object file '"
+                 << compiland->object_file << "'";
+      return false;
+    } else {
+      // If two or more functions inside an object file are folded, we'll
+      // accrue and report the code contribution to only one of the instances.
+      // TODO(siggi): In the case of e.g. template instantiations, this will
+      //    incorrectly attribute all the contribution to one of the
+      //    instantiations, which skews the tally a bit. Maybe better is to
+      //    maintain a per-function size, keep all the function names around
+      //    and report the contribution for each distinct function as 1/Nth of
+      //    the total sum of contributions.
+      LOG(INFO) << "Overlapping functions '"
+                << com::ToString(name) << "' and '"
+                << it->second.name << "' in object file '"
+                << compiland->object_file << "'";
+    }
+  }
+
+  return true;
+}
+
+bool CodeTally::CompilandWorker::OnLine(CompilandInfo* compiland,
+                                        IDiaLineNumber* line_number) {
+  DCHECK(compiland != NULL);
+  DCHECK(line_number != NULL);
+
+  DWORD rva = 0;
+  HRESULT hr = line_number->get_relativeVirtualAddress(&rva);
+  if (hr != S_OK) {
+    LOG(ERROR) << "Failed to get RVA for line: " << com::LogHr(hr);
+    return false;
+  }
+
+  DWORD length = 0;
+  hr = line_number->get_length(&length);
+  if (hr != S_OK) {
+    LOG(ERROR) << "Failed to get length for line: " << com::LogHr(hr);
+    return false;
+  }
+
+  // Account for the code usage.
+  tally_->UseRange(rva, length);
+
+  base::win::ScopedComPtr<IDiaSourceFile> source_file;
+  hr = line_number->get_sourceFile(source_file.Receive());
+  if (hr != S_OK) {
+    LOG(ERROR) << "Failed to get source file for line: " << com::LogHr(hr);
+    return false;
+  }
+
+  base::win::ScopedBstr source_name;
+  hr = source_file->get_fileName(source_name.Receive());
+  if (hr != S_OK) {
+    LOG(ERROR) << "Failed to get source file name for line: " << com::LogHr(hr);
+    return false;
+  }
+
+  DWORD line = 0;
+  hr = line_number->get_lineNumber(&line);
+  if (hr != S_OK) {
+    LOG(ERROR) << "Failed to get line number: " << com::LogHr(hr);
+    return false;
+  }
+
+  FunctionRange line_range(rva, length ? length : 1);
+  FunctionInfoAddressSpace::iterator it =
+      compiland->functions.FindContaining(line_range);
+  if (it == compiland->functions.end()) {
+    LOG(ERROR) << "Line info outside function in object file '"
+               << compiland->object_file << "' source file '"
+               << com::ToString(source_name) << "' at line: " << line;
+    return true;
+  }
+
+  FunctionInfo::LineData line_data = {};
+
+  line_data.source_file =
+      FindOrCreateSourceFileInfo(com::ToString(source_name), &source_files_);
+  DCHECK(line_data.source_file != NULL);
+
+  // The code contribution is accrued once all use counts are known.
+  line_data.offset = rva - it->first.start();
+  line_data.length = length;
+  line_data.line = line;
+
+  FunctionInfo& function_info = it->second;
+  function_info.line_info.push_back(line_data);
+
+  return true;
+}
+
 CodeTally::CodeTally(const base::FilePath& image_file) :
-    image_file_(image_file) {
+    image_file_(image_file), num_threads_(1), next_compiland_(0) {
+}
+
+CodeTally::~CodeTally() {
 }
 
 bool CodeTally::TallyLines(const base::FilePath& pdb_file) {
@@ -134,22 +405,68 @@ bool CodeTally::TallyLines(const base::FilePath& pdb_file) {
     return false;
   }
 
-  hr = data_source->openSession(session_.Receive());
+  base::win::ScopedComPtr<IDiaSession> session;
+  hr = data_source->openSession(session.Receive());
   if (FAILED(hr)) {
     LOG(ERROR) << "Unable to open session: " << com::LogHr(hr);
     return false;
   }
 
-  pe::CompilandVisitor visitor(session_);
-  if (!visitor.VisitAllCompilands(base::Bind(&CodeTally::OnCompilandPassOne,
-                                        base::Unretained(this)))) {
-    return false;
+  // Gather the compilands up front, so they can be handed out to the workers
+  // by index.
+  compiland_ids_.clear();
+  {
+    pe::CompilandVisitor visitor(session);
+    if (!visitor.VisitAllCompilands(base::Bind(&GetSymbolId,
+                                               &compiland_ids_))) {
+      return false;
+    }
   }
-  if (!visitor.VisitAllCompilands(base::Bind(&CodeTally::OnCompilandPassTwo,
-                                              base::Unretained(this)))) {
-    return false;
+
+  // The workers open their own sessions.
+  session.Release();
+  data_source.Release();
+
+  compilands_.clear();
+  for (size_t i = 0; i < compiland_ids_.size(); ++i)
+    compilands_.push_back(new CompilandInfo());
+  next_compiland_ = 0;
+  use_counts_.assign(image_signature_.module_size, 0);
+
+  size_t num_threads = std::max(static_cast<size_t>(1),
+                                std::min(num_threads_, compiland_ids_.size()));
+  LOG(INFO) << "Tallying " << compiland_ids_.size() << " compilands on "
+            << num_threads << " threads.";
+
+  // Walk the compilands. The workers keep the source files of the lines they
+  // collected, so they must outlive the merge.
+  ScopedVector<CompilandWorker> workers;
+  for (size_t i = 0; i < num_threads; ++i)
+    workers.push_back(new CompilandWorker(this, found_pdb));
+
+  {
+    base::DelegateSimpleThreadPool pool("CodeTally",
+                                        static_cast<int>(num_threads));
+    pool.Start();
+    for (size_t i = 0; i < workers.size(); ++i)
+      pool.AddWork(workers[i]);
+    pool.JoinAll();
   }
 
+  for (size_t i = 0; i < workers.size(); ++i) {
+    if (!workers[i]->succeeded())
+      return false;
+  }
+
+  // Now that we know the share count for each byte in the executable, we can
+  // calculate accurate code contributions by line. Merging in compiland order
+  // makes the result independent of the order the compilands were walked in.
+  for (size_t i = 0; i < compilands_.size(); ++i) {
+    if (!MergeCompiland(compilands_[i]))
+      return false;
+  }
+  compilands_.clear();
+
   return true;
 }
 
@@ -294,236 +611,106 @@ bool CodeTally::GenerateJsonOutput(core::JSONFileWriter* writer) {
 }
 
 CodeTally::SourceFileInfo* CodeTally::FindOrCreateSourceFileInfo(
-    const wchar_t* source_file) {
+    const wchar_t* source_file, SourceFileInfoMap* files) {
   DCHECK(source_file != NULL);
+  DCHECK(files != NULL);
 
-  SourceFileInfoMap::iterator it(source_files_.find(source_file));
-  if (it == source_files_.end()) {
-    it = source_files_.insert(
-        std::make_pair(source_file, SourceFileInfo())).first;
+  SourceFileInfoMap::iterator it(files->find(source_file));
+  if (it == files->end()) {
+    it = files->insert(std::make_pair(source_file, SourceFileInfo())).first;
     it->second.file_name = it->first.c_str();
   }
 
-  DCHECK(it != source_files_.end());
+  DCHECK(it != files->end());
   return &it->second;
 }
 
 CodeTally::ObjectFileInfo* CodeTally::FindOrCreateObjectFileInfo(
-    const wchar_t* object_file) {
+    const wchar_t* object_file, ObjectFileInfoMap* files) {
   DCHECK(object_file != NULL);
+  DCHECK(files != NULL);
 
-  ObjectFileInfoMap::iterator it(object_files_.find(object_file));
-  if (it == object_files_.end()) {
-    it = object_files_.insert(
-        std::make_pair(object_file, ObjectFileInfo())).first;
+  ObjectFileInfoMap::iterator it(files->find(object_file));
+  if (it == files->end()) {
+    it = files->insert(std::make_pair(object_file, ObjectFileInfo())).first;
     it->second.file_name = it->first.c_str();
   }
 
-  DCHECK(it != object_files_.end());
+  DCHECK(it != files->end());
   return &it->second;
 }
 
 void CodeTally::UseRange(size_t start, size_t len) {
-  if (use_counts_.size() < start + len)
-    use_counts_.resize(start + len, 0);
-
-  for (size_t i = 0; i < len; ++i)
-    ++use_counts_[start + i];
+  // Bytes outside the image have no use count, and are deemed unshared.
+  size_t end = std::min(start + len, use_counts_.size());
+  for (size_t i = start; i < end; ++i)
+    base::subtle::NoBarrier_AtomicIncrement(&use_counts_[i], 1);
 }
 
-double CodeTally::CalculateByteContribution(size_t start, size_t len) {
-  DCHECK_LE(start + len, use_counts_.size());
+double CodeTally::CalculateByteContribution(size_t start, size_t len) const {
   double sum = 0.0;
   while (len != 0) {
-    sum += 1.0 / use_counts_[start];
+    if (start >= use_counts_.size() || use_counts_[start] == 0)
+      sum += 1.0;
+    else
+      sum += 1.0 / use_counts_[start];
     ++start;
     --len;
   }
   return sum;
 }
 
-bool CodeTally::OnCompilandPassOne(IDiaSymbol* compiland) {
-  DCHECK(pe::IsSymTag(compiland, SymTagCompiland));
-
-  base::win::ScopedBstr compiland_name;
-  HRESULT hr = compiland->get_name(compiland_name.Receive());
-
-  // On the first pass, we simply crawl the source lines in this compiland
-  // and update the share counts for each referenced byte.
-  pe::LineVisitor visitor(session_, compiland);
-  return visitor.VisitLines(
-      base::Bind(&CodeTally::OnLinePassOne, base::Unretained(this)));
+size_t CodeTally::NextCompiland() {
+  size_t next = static_cast<size_t>(
+      base::subtle::NoBarrier_AtomicIncrement(&next_compiland_, 1));
+  return std::min(next - 1, compiland_ids_.size());
 }
 
-bool CodeTally::OnCompilandPassTwo(IDiaSymbol* compiland) {
+bool CodeTally::MergeCompiland(CompilandInfo* compiland) {
   DCHECK(compiland != NULL);
 
-  base::win::ScopedBstr compiland_name;
-  HRESULT hr = compiland->get_name(compiland_name.Receive());
   ObjectFileInfo* object_file =
-      FindOrCreateObjectFileInfo(com::ToString(compiland_name));
-
-  pe::ChildVisitor function_visitor(compiland, SymTagFunction);
-  if (!function_visitor.VisitChildren(
-          base::Bind(&CodeTally::OnFunction,
-                     base::Unretained(this),
-                     object_file))) {
-    return false;
-  }
-
-  // On the second pass we know the share count for each byte in the executable,
-  // so we can calculate accurate code contributions by line.
-  pe::LineVisitor line_visitor(session_, compiland);
-
-  return line_visitor.VisitLines(
-      base::Bind(&CodeTally::OnLinePassTwo,
-                 base::Unretained(this),
-                 object_file));
-}
-
-bool CodeTally::OnLinePassOne(IDiaLineNumber* line_number) {
-  DCHECK(line_number != NULL);
-
-  DWORD rva = 0;
-  HRESULT hr = line_number->get_relativeVirtualAddress(&rva);
-  if (hr != S_OK) {
-    LOG(ERROR) << "Failed to get line number RVA: " << com::LogHr(hr);
-    return false;
-  }
-  DWORD length = 0;
-  hr = line_number->get_length(&length);
-  if (hr != S_OK) {
-    LOG(ERROR) << "Failed to get line number length: " << com::LogHr(hr);
-    return false;
-  }
-
-  // Account for the code usage.
-  UseRange(rva, length);
-
-  return true;
-}
-
-bool CodeTally::OnFunction(ObjectFileInfo* object_file, IDiaSymbol* function) {
-  DCHECK(object_file != NULL);
-  DCHECK(function != NULL);
-
-  DWORD rva = 0;
-  HRESULT hr = function->get_relativeVirtualAddress(&rva);
-  if (hr != S_OK) {
-    LOG(ERROR) << "Failed to get function RVA: " << com::LogHr(hr);
-    return false;
-  }
-
-  ULONGLONG length = 0;
-  hr = function->get_length(&length);
-  if (hr != S_OK || length > MAXINT) {
-    LOG(ERROR) << "Failed to get function length: " << com::LogHr(hr);
-    return false;
-  }
+      FindOrCreateObjectFileInfo(compiland->object_file.c_str(),
+                                 &object_files_);
+
+  FunctionInfoAddressSpace::iterator fun_it(compiland->functions.begin());
+  for (; fun_it != compiland->functions.end(); ++fun_it) {
+    const FunctionRange& range = fun_it->first;
+    FunctionInfo& function = fun_it->second;
+
+    // Accrue the code contribution of the lines, and move them over to our
+    // own source files.
+    for (size_t i = 0; i < function.line_info.size(); ++i) {
+      FunctionInfo::LineData& line = function.line_info[i];
+      line.source_file = FindOrCreateSourceFileInfo(line.source_file->file_name,
+                                                    &source_files_);
+      line.code_bytes = CalculateByteContribution(range.start() + line.offset,
+                                                  line.length);
+    }
 
-  base::win::ScopedBstr name;
-  hr = function->get_name(name.Receive());
-  if (hr != S_OK) {
-    LOG(ERROR) << "Failed to get function name: " << com::LogHr(hr);
-    return false;
-  }
+    // Compilands that contribute to the same object file share its
+    // functions, as folded functions do.
+    FunctionInfoAddressSpace::iterator it;
+    if (!object_file->functions.Insert(range,
+                                       FunctionInfo(function.name.c_str()),
+                                       &it)) {
+      it = object_file->functions.FindContaining(range);
+      if (it == object_file->functions.end() || it->first != range) {
+        LOG(ERROR) << "Function '" << function.name
+                   << "' overlaps another function in object file '"
+                   << object_file->file_name << "'";
+        return false;
+      }
+    }
 
-  FunctionRange range(rva, static_cast<size_t>(length));
-  if (!object_file->functions.Insert(range,
-                                     FunctionInfo(com::ToString(name)))) {
-    FunctionInfoAddressSpace::iterator it =
-        object_file->functions.FindContaining(range);
-    if (it == object_file->functions.end()) {
-      LOG(ERROR) << "Overlapping function info for '"
-                 << com::ToString(name) << "'";
-      return false;
-    } else if (it->first != range) {
-      LOG(ERROR) << "Function '"
-                 << com::ToString(name) << "' partially overlaps function '"
-                 << it->second.name << "' in object file '"
-                 << object_file->file_name << "'";
-      return false;
+    std::vector<FunctionInfo::LineData>& line_info = it->second.line_info;
+    if (line_info.empty()) {
+      line_info.swap(function.line_info);
     } else {
-      // If two or more functions inside an object file are folded, we'll
-      // accrue and report the code contribution to only one of the instances.
-      // TODO(siggi): In the case of e.g. template instantiations, this will
-      //    incorrectly attribute all the contribution to one of the
-      //    instantiations, which skews the tally a bit. Maybe better is to
-      //    maintain a per-function size, keep all the function names around
-      //    and report the contribution for each distinct function as 1/Nth of
-      //    the total sum of contributions.
-      LOG(INFO) << "Overlapping functions '"
-                << com::ToString(name) << "' and '"
-                << it->second.name << "' in object file '"
-                << object_file->file_name << "'";
+      line_info.insert(line_info.end(), function.line_info.begin(),
+                       function.line_info.end());
     }
   }
 
   return true;
 }
-
-bool CodeTally::OnLinePassTwo(ObjectFileInfo* object_file,
-                              IDiaLineNumber* line_number) {
-  DCHECK(object_file != NULL);
-  DCHECK(line_number != NULL);
-
-  DWORD rva = 0;
-  HRESULT hr = line_number->get_relativeVirtualAddress(&rva);
-  if (hr != S_OK) {
-    LOG(ERROR) << "Failed to get RVA for line: " << com::LogHr(hr);
-    return false;
-  }
-
-  DWORD length = 0;
-  hr = line_number->get_length(&length);
-  if (hr != S_OK) {
-    LOG(ERROR) << "Failed to get length for line: " << com::LogHr(hr);
-    return false;
-  }
-
-  base::win::ScopedComPtr<IDiaSourceFile> source_file;
-  hr = line_number->get_sourceFile(source_file.Receive());
-  if (hr != S_OK) {
-    LOG(ERROR) << "Failed to get source file for line: " << com::LogHr(hr);
-    return false;
-  }
-
-  base::win::ScopedBstr source_name;
-  hr = source_file->get_fileName(source_name.Receive());
-  if (hr != S_OK) {
-    LOG(ERROR) << "Failed to get source file name for line: " << com::LogHr(hr);
-    return false;
-  }
-
-  DWORD line = 0;
-  hr = line_number->get_lineNumber(&line);
-  if (hr != S_OK) {
-    LOG(ERROR) << "Failed to get line number: " << com::LogHr(hr);
-    return false;
-  }
-
-  FunctionRange line_range(rva, length ? length : 1);
-  FunctionInfoAddressSpace::iterator it =
-      object_file->functions.FindContaining(line_range);
-  if (it == object_file->functions.end()) {
-    LOG(ERROR) << "Line info outside function in object file '"
-               << object_file->file_name << "' source file '"
-               << com::ToString(source_name) << "' at line: " << line;
-    return true;
-  }
-
-  FunctionInfo::LineData line_data = {};
-
-  line_data.source_file =
-      FindOrCreateSourceFileInfo(com::ToString(source_name));
-  DCHECK(line_data.source_file != NULL);
-
-  line_data.offset = rva - it->first.start();
-  line_data.line = line;
-  line_data.code_bytes = CalculateByteContribution(rva, length);
-
-  FunctionInfo& function_info = it->second;
-  function_info.line_info.push_back(line_data);
-
-  return true;
-}
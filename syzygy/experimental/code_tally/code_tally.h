@@ -25,7 +25,9 @@
 
 #include "base/callback.h"
 #include "base/file_version_info.h"
+#include "base/atomicops.h"
 #include "base/files/file_path.h"
+#include "base/memory/scoped_vector.h"
 #include "base/win/scoped_comptr.h"
 #include "syzygy/core/address_space.h"
 #include "syzygy/pe/pe_file.h"
@@ -108,15 +110,28 @@ class JSONFileWriter;
 // template function may expand to identical code for multiple types, but the
 // linker may then fold all the identical template expansions to a single,
 // canonical function.
-// We therefore have to iterate through the source lines twice:
-// - On the first pass we update the use counts for each byte referenced from
-//   source line contribution.
-// - On the second pass we know how often each code byte is shared, and so
-//   we can accrue the correct tally.
+// We therefore walk the source lines once, recording each line's code range
+// while updating the use counts of the bytes it references, and only accrue
+// the code contribution of the lines once the walk is complete and we know
+// how often each code byte is shared.
+//
+// The walk is sharded by compiland across worker threads, each with its own
+// DIA session, as DIA sessions aren't thread safe. The use counts are shared
+// and updated atomically, while each compiland's functions and lines are
+// collected separately and merged in compiland order once all workers are
+// done, so the output doesn't depend on the number of threads.
 class CodeTally {
  public:
   // Creates a code tally instance for the given image file.
   explicit CodeTally(const base::FilePath& image_file);
+  ~CodeTally();
+
+  // @name Accessors.
+  // @{
+  // The number of worker threads the compilands are walked on. Defaults to 1.
+  size_t num_threads() const { return num_threads_; }
+  void set_num_threads(size_t num_threads) { num_threads_ = num_threads; }
+  // @}
 
   // Crawls the PDB file and updates internal state with code contribution
   // down to function, source line per object file.
@@ -130,6 +145,8 @@ class CodeTally {
   struct FunctionInfo;
   struct ObjectFileInfo;
   struct SourceFileInfo;
+  struct CompilandInfo;
+  class CompilandWorker;
 
   typedef std::map<std::wstring, SourceFileInfo> SourceFileInfoMap;
   typedef std::map<std::wstring, ObjectFileInfo> ObjectFileInfoMap;
@@ -138,30 +155,34 @@ class CodeTally {
       FunctionInfoAddressSpace;
   typedef FunctionInfoAddressSpace::Range FunctionRange;
 
-  SourceFileInfo* FindOrCreateSourceFileInfo(const wchar_t* source_file);
-  ObjectFileInfo* FindOrCreateObjectFileInfo(const wchar_t* object_file);
+  // Finds or creates the named source or object file info in @p files.
+  static SourceFileInfo* FindOrCreateSourceFileInfo(const wchar_t* source_file,
+                                                    SourceFileInfoMap* files);
+  static ObjectFileInfo* FindOrCreateObjectFileInfo(const wchar_t* object_file,
+                                                    ObjectFileInfoMap* files);
 
-  // Increases the use count for bytes [start, start + len) by one.
+  // Increases the use count for bytes [start, start + len) by one. This is
+  // safe to call concurrently.
   void UseRange(size_t start, size_t len);
 
   // Sums up the total code contribution by the bytes in [start, start + len).
-  double CalculateByteContribution(size_t start, size_t len);
+  double CalculateByteContribution(size_t start, size_t len) const;
 
-  // Callbacks for compiland enumeration.
-  bool OnCompilandPassOne(IDiaSymbol* compiland);
-  bool OnCompilandPassTwo(IDiaSymbol* compiland);
+  // @returns the index of the next compiland to walk, or the number of
+  //     compilands once they have all been handed out. This is safe to call
+  //     concurrently.
+  size_t NextCompiland();
 
-  // Callback for line enumeration.
-  // First pass only updates all use counts.
-  bool OnLinePassOne(IDiaLineNumber* line_number);
+  // Merges the functions and lines of @p compiland, collected by a worker,
+  // into object_files_ and source_files_, and accrues the code contribution
+  // of its lines.
+  bool MergeCompiland(CompilandInfo* compiland);
 
-  // Callback for Function enumeration.
-  bool OnFunction(ObjectFileInfo* object_file, IDiaSymbol* function);
+  // The image file we work on.
+  base::FilePath image_file_;
 
-  // The second pass can accurately tally code contribution as
-  // the first pass has calculated the sharing (use) count of
-  // each byte in the binary.
-  bool OnLinePassTwo(ObjectFileInfo* object_file, IDiaLineNumber* line_number);
+  // The number of worker threads.
+  size_t num_threads_;
 
   // The image file we work on.
   base::FilePath image_file_;
@@ -174,8 +195,13 @@ class CodeTally {
   // TallyLines.
   scoped_ptr<FileVersionInfo> image_file_version_;
 
-  // The DIA session this instance works with.
-  base::win::ScopedComPtr<IDiaSession> session_;
+  // The ids of the compilands to walk, and the index of the next compiland
+  // to hand out to a worker.
+  std::vector<DWORD> compiland_ids_;
+  base::subtle::Atomic32 next_compiland_;
+
+  // The functions and lines of each compiland, as collected by the workers.
+  ScopedVector<CompilandInfo> compilands_;
 
   // Maps from object file name to ObjectFileInfo.
   ObjectFileInfoMap object_files_;
@@ -184,8 +210,9 @@ class CodeTally {
   SourceFileInfoMap source_files_;
 
   // Keeps track of how many times each byte in Chrome.dll was referenced from
-  // any source line.
-  std::vector<size_t> use_counts_;
+  // any source line. Sized to the image, and updated atomically by the
+  // workers.
+  std::vector<base::subtle::Atomic32> use_counts_;
 
   DISALLOW_COPY_AND_ASSIGN(CodeTally);
 };
@@ -210,6 +237,7 @@ struct CodeTally::FunctionInfo {
   struct LineData {
     CodeTally::SourceFileInfo* source_file;
     size_t offset;
+    size_t length;
     size_t line;
     double code_bytes;
   };
@@ -242,4 +270,14 @@ struct CodeTally::SourceFileInfo {
   std::vector<CodeTally::LineInfo> line_code;
 };
 
+// Data collected per compiland by a worker, before being merged.
+struct CodeTally::CompilandInfo {
+  // The object file this compiland contributes to.
+  std::wstring object_file;
+
+  // The functions of this compiland. The source files of their lines belong
+  // to the worker that collected them.
+  FunctionInfoAddressSpace functions;
+};
+
 #endif  // SYZYGY_EXPERIMENTAL_CODE_TALLY_CODE_TALLY_H_
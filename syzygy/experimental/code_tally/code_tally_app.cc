@@ -17,7 +17,9 @@
 #include "base/at_exit.h"
 #include "base/command_line.h"
 #include "base/file_util.h"
+#include "base/string_number_conversions.h"
 #include "base/string_util.h"
+#include "base/stringprintf.h"
 #include "syzygy/core/json_file_writer.h"
 #include "syzygy/pe/pe_file.h"
 
@@ -45,7 +47,16 @@ const char kUsageFormatStr[] =
     "      Optionally provide the name or path to the output file. If not\n"
     "      provided, output will be to standard out.\n"
     "  --pretty-print\n"
-    "      If provided, the JSON output will be pretty printed.\n";
+    "      If provided, the JSON output will be pretty printed.\n"
+    "  --threads=<count>\n"
+    "      The number of threads to walk the symbol information on, each with\n"
+    "      its own DIA session. Defaults to 1.\n";
+
+// The most worker threads we allow, as each loads the symbol file.
+const size_t kMaxThreads = 64;
+
+// The size of the buffer the JSON output is written through.
+const size_t kOutputBufferSize = 1024 * 1024;
 
 }  // namespace
 
@@ -82,6 +93,18 @@ bool CodeTallyApp::ParseCommandLine(const CommandLine* cmd_line) {
   // Check the pretty print flag.
   pretty_print_ = cmd_line->HasSwitch("pretty-print");
 
+  std::string threads = cmd_line->GetSwitchValueASCII("threads");
+  if (!threads.empty()) {
+    if (!base::StringToSizeT(threads, &threads_) ||
+        threads_ < 1 || threads_ > kMaxThreads) {
+      PrintUsage(cmd_line->GetProgram(),
+                 base::StringPrintf("The number of threads must be between "
+                                    "1 and %d.",
+                                    static_cast<int>(kMaxThreads)));
+      return false;
+    }
+  }
+
   return true;
 }
 
@@ -106,14 +129,22 @@ int CodeTallyApp::Run() {
     output_file = scoped_file.get();
   }
 
+  // The JSON writer emits many small writes, so stream them through a large
+  // buffer.
+  if (::setvbuf(output_file, NULL, _IOFBF, kOutputBufferSize) != 0) {
+    LOG(ERROR) << "Unable to set the output buffer size.";
+    return 1;
+  }
+
   // Do the tally.
   CodeTally tally(input_image_);
+  tally.set_num_threads(threads_);
   if (!tally.TallyLines(input_pdb_))
     return 1;
 
   // And write the output file.
   core::JSONFileWriter writer(output_file, pretty_print_);
-  if (!tally.GenerateJsonOutput(&writer))
+  if (!tally.GenerateJsonOutput(&writer) || ::fflush(output_file) != 0)
     return 1;
 
   return 0;
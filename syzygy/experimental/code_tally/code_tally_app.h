@@ -34,7 +34,8 @@ class CodeTallyApp : public common::AppImplBase {
  public:
   // @name Implementation of the AppImplBase interface.
   // @{
-  CodeTallyApp() : common::AppImplBase("CodeTally"), pretty_print_(false) {
+  CodeTallyApp()
+      : common::AppImplBase("CodeTally"), pretty_print_(false), threads_(1) {
   }
 
   bool ParseCommandLine(const CommandLine* command_line);
@@ -56,6 +57,7 @@ class CodeTallyApp : public common::AppImplBase {
   base::FilePath input_pdb_;
   base::FilePath output_file_;
   bool pretty_print_;
+  size_t threads_;
   // @}
 
  private:
@@ -24,14 +24,19 @@
 // bucket with only two blocks in it, one from each block graph, then we
 // assume the blocks are semantically equivalent across the versions.
 //
-// Currently we have two features we use. The first is the physical content of
+// Currently we have three features we use. The first is the physical content of
 // the block, minus the actual values of any references. Blocks that contain
 // identical code/values are very likely to be the same block across versions.
 // The second is the decorated name of the block. Decorated names encode the
 // original name of the function in source code, plus the names of the types
 // passed in to it.
 //
-// These two approaches are complementary. It is possible that a refactor
+// The third is the shape of the block: its type, sizes and number of
+// references and referrers. This is only a weak indication of similarity, so
+// it is used as a fallback once nothing more can be matched by the other
+// features.
+//
+// The first two approaches are complementary. It is possible that a refactor
 // simply changed the name of a type or a function. In this case, the decorated
 // names will have changed, but the block contents will not. Similarly, it is
 // possible (and more likely) that the contents of a block have changed. If the
@@ -72,8 +77,14 @@
 
 #include <algorithm>
 
+#include "base/bind.h"
+#include "base/hash_tables.h"
 #include "base/logging.h"
 #include "base/md5.h"
+#include "base/memory/scoped_vector.h"
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
+#include "syzygy/core/closure_delegate.h"
 #include "syzygy/experimental/compare/block_compare.h"
 #include "syzygy/experimental/compare/block_hash.h"
 #include "syzygy/experimental/compare/comparable.h"
@@ -87,19 +98,27 @@ namespace {
 
 const size_t kInvalidIndex = -1;
 
+// The minimum number of blocks whose metadata is initialized by a worker
+// thread. Below this the threading overhead isn't worth it.
+const size_t kMinBlocksPerMetadataShard = 256;
+
 // Features are properties of blocks that are used to match up blocks between
 // block graphs. If there exists exactly one block in each graph with the same
 // value for the given feature, the blocks are assumed to be the same. We
-// currently use two features: block hash, and block name.
+// currently use three features: block name, block hash and block shape.
 //
 // The order of these features indicates the order of priority for making
 // matches. For example, it is possible that feature 0 wants to match block
 // A with match B, but that feature 1 wants to match block A with block C. In
 // this case, A will be matched with B and an informational warning will be
 // printed about the conflicting A/C match.
+//
+// The shape feature is a fallback. It is only used to seed matches once
+// nothing more can be matched by the features preceding it.
 enum BlockFeatures {
   kNameFeature,
   kHashFeature,
+  kShapeFeature,
   // This needs to come last.
   kFeatureCount
 };
@@ -140,6 +159,10 @@ class BlockFeature {
   // Initializes the metadata for this feature and the given @p block.
   virtual bool InitMetadata(BlockMetadata* metadata) const = 0;
 
+  // Returns true if InitMetadata is expensive enough to be worth running on
+  // several threads.
+  virtual bool InitMetadataIsExpensive() const { return false; }
+
   // Compares two blocks, returning their relative sort order (-1, 0, 1).
   virtual int Compare(const BlockMetadata& metadata0,
                       const BlockMetadata& metadata1) const = 0;
@@ -153,6 +176,79 @@ class BlockFeature {
   DISALLOW_COPY_AND_ASSIGN(BlockFeature);
 };
 
+// A contiguous range of block metadata to be initialized by a worker thread.
+// The metadata of distinct blocks is disjoint, so the shards can be processed
+// concurrently.
+struct MetadataShard {
+  MetadataShard(const BlockFeature* block_feature,
+                BlockMetadata* const* begin,
+                BlockMetadata* const* end)
+      : block_feature(block_feature), begin(begin), end(end),
+        succeeded(false) {
+    DCHECK(block_feature != NULL);
+  }
+
+  void Run() {
+    for (BlockMetadata* const* it = begin; it != end; ++it) {
+      if (!block_feature->InitMetadata(*it))
+        return;
+    }
+    succeeded = true;
+  }
+
+  const BlockFeature* block_feature;
+  BlockMetadata* const* begin;
+  BlockMetadata* const* end;
+  bool succeeded;
+};
+
+// Initializes the metadata of the given blocks for @p block_feature. This uses
+// one worker thread per processor if the initialization is expensive.
+bool InitMetadata(const BlockFeature& block_feature,
+                  const std::vector<BlockMetadata*>& metadata) {
+  if (metadata.empty())
+    return true;
+
+  size_t threads = 1;
+  if (block_feature.InitMetadataIsExpensive())
+    threads = base::SysInfo::NumberOfProcessors();
+  size_t shard_count = std::min(
+      threads, metadata.size() / kMinBlocksPerMetadataShard + 1);
+  size_t shard_size = (metadata.size() + shard_count - 1) / shard_count;
+
+  ScopedVector<MetadataShard> shards;
+  for (size_t i = 0; i < metadata.size(); i += shard_size) {
+    size_t end = std::min(metadata.size(), i + shard_size);
+    shards.push_back(new MetadataShard(&block_feature,
+                                       &metadata[0] + i,
+                                       &metadata[0] + end));
+  }
+
+  if (shards.size() == 1) {
+    shards[0]->Run();
+  } else {
+    ScopedVector<core::ClosureDelegate> work;
+    for (size_t i = 0; i < shards.size(); ++i) {
+      work.push_back(new core::ClosureDelegate(
+          base::Bind(&MetadataShard::Run, base::Unretained(shards[i]))));
+    }
+
+    base::DelegateSimpleThreadPool pool("BlockMetadata",
+                                        static_cast<int>(shards.size()));
+    pool.Start();
+    for (size_t i = 0; i < work.size(); ++i)
+      pool.AddWork(work[i]);
+    pool.JoinAll();
+  }
+
+  for (size_t i = 0; i < shards.size(); ++i) {
+    if (!shards[i]->succeeded)
+      return false;
+  }
+
+  return true;
+}
+
 // This is the generic data structure for an index over some feature of a
 // block.
 class FeatureIndex {
@@ -294,8 +390,9 @@ class FeatureIndex {
   }
 
   // Populates block_infos_ and block_metadata_ with the blocks from the
-  // given BlockGraph.
-  bool AddBlocks(const BlockFeature& block_feature,
+  // given BlockGraph. The metadata of the blocks for this feature is
+  // initialized afterwards, in bulk.
+  void AddBlocks(const BlockFeature& block_feature,
                  size_t block_graph_index,
                  const BlockGraph& block_graph) {
     DCHECK(block_graph_index == 0 || block_graph_index == 1);
@@ -317,18 +414,12 @@ class FeatureIndex {
             std::make_pair(block, metadata)).first;
       }
 
-      // Initialize any metadata for this feature.
-      if (!block_feature.InitMetadata(&metadata_it->second))
-        return false;
-
       // Add this block to block_infos_.
       BlockInfo block_info(&metadata_it->second,
                            block_graph_index,
                            block_feature.id());
       block_infos_.push_back(block_info);
     }
-
-    return true;
   }
 
   // Maps the given block, returning its feature bucket.
@@ -421,8 +512,10 @@ class FeatureIndex {
   std::vector<FeatureInfo> feature_infos_;
 
   // There is a sinlge instance of block metadata shared across all
-  // FeatureIndex objects.
-  typedef std::map<const BlockGraph::Block*, BlockMetadata> BlockMetadataMap;
+  // FeatureIndex objects. The values of a hash_map are stable, so BlockInfo
+  // can safely point into it.
+  typedef base::hash_map<const BlockGraph::Block*, BlockMetadata>
+      BlockMetadataMap;
   static BlockMetadataMap block_metadata_;
 
   // This is copied from the BlockFeature provided in the constructor.
@@ -444,9 +537,17 @@ FeatureIndex::FeatureIndex(const BlockFeature& block_feature,
   // Add the blocks to block_infos_, and initialize metadata.
   block_infos_.reserve(block_graph0.blocks().size() +
       block_graph1.blocks().size());
-  if (!AddBlocks(block_feature, 0, block_graph0))
+  AddBlocks(block_feature, 0, block_graph0);
+  AddBlocks(block_feature, 1, block_graph1);
+  if (block_infos_.empty())
     return;
-  if (!AddBlocks(block_feature, 1, block_graph1))
+
+  // Initialize the metadata for this feature. This is where the blocks get
+  // hashed, which may be done in parallel.
+  std::vector<BlockMetadata*> metadata(block_infos_.size());
+  for (size_t i = 0; i < block_infos_.size(); ++i)
+    metadata[i] = block_infos_[i].metadata;
+  if (!InitMetadata(block_feature, metadata))
     return;
 
   // Sort block_infos_.
@@ -461,6 +562,7 @@ FeatureIndex::FeatureIndex(const BlockFeature& block_feature,
   block_infos_[0].feature_bucket = feature_bucket;
   block_infos_[0].metadata->feature_index[feature_id_] = 0;
   feature_infos_.resize(1);
+  feature_infos_[0].block_count[block_infos_[0].block_graph_index]++;
   size_t i = 1;
   for (; i < block_infos_.size(); ++i) {
     int c = block_feature.Compare(*block_infos_[i - 1].metadata,
@@ -512,6 +614,8 @@ class BlockHashFeature : public BlockFeature {
     return true;
   }
 
+  virtual bool InitMetadataIsExpensive() const { return true; }
+
   virtual int Compare(const BlockMetadata& metadata0,
                       const BlockMetadata& metadata1) const {
     int c = metadata0.block_hash.Compare(metadata1.block_hash);
@@ -549,6 +653,49 @@ class BlockNameFeature : public BlockFeature {
   }
 };
 
+// Groups blocks by their shape: type, size, data size, and number of
+// references and referrers. Blocks with the same shape are only similar, so
+// this is used as a fallback.
+class BlockShapeFeature : public BlockFeature {
+ public:
+  BlockShapeFeature() : BlockFeature(kShapeFeature) {
+  }
+
+  virtual bool InitMetadata(BlockMetadata* metadata) const {
+    return true;
+  }
+
+  virtual int Compare(const BlockMetadata& metadata0,
+                      const BlockMetadata& metadata1) const {
+    const BlockGraph::Block* block0 = metadata0.block;
+    const BlockGraph::Block* block1 = metadata1.block;
+    int c = CompareValues(block0->type(), block1->type());
+    if (c == 0)
+      c = CompareValues(block0->size(), block1->size());
+    if (c == 0)
+      c = CompareValues(block0->data_size(), block1->data_size());
+    if (c == 0) {
+      c = CompareValues(block0->references().size(),
+                        block1->references().size());
+    }
+    if (c == 0) {
+      c = CompareValues(block0->referrers().size(),
+                        block1->referrers().size());
+    }
+    return c;
+  }
+
+ private:
+  template<typename T>
+  static int CompareValues(const T& value0, const T& value1) {
+    if (value0 < value1)
+      return -1;
+    if (value1 < value0)
+      return 1;
+    return 0;
+  }
+};
+
 // This is for storing a list of unique referrers keyed by destination address.
 typedef std::map<BlockGraph::Offset,
                  std::pair<const BlockGraph::Block*, size_t> >
@@ -585,6 +732,9 @@ void BuildUniqueReferrerMap(const BlockGraph::Block* block,
 
 class BlockGraphMapper {
  public:
+  BlockGraphMapper() : mapping_(NULL), use_fallback_features_(false) {
+  }
+
   // Builds the mapping between the two given block graphs, and if provided,
   // populates the vector of unmapped blocks left in each block graph.
   bool BuildMapping(const BlockGraph& bg0,
@@ -627,12 +777,31 @@ class BlockGraphMapper {
   bool ScheduleIfUnmapped(const BlockGraph::Block* block0,
                           const BlockGraph::Block* block1);
 
+  // Schedules the mappings of all buckets of the given feature that contain a
+  // single unmapped block from each block graph.
+  bool ScheduleUniqueBucketMappings(size_t feature_id);
+
+  // Maps all pending blocks, and whatever mappings they lead to.
+  bool MapPendingBlocks();
+
+  // Returns true if the given feature is used to match blocks. The name
+  // feature may be disabled, and the fallback features are only used once
+  // nothing more can be matched otherwise.
+  bool UseFeature(size_t feature_id) const {
+    if (feature_indices_[feature_id] == NULL)
+      return false;
+    return feature_id < kShapeFeature || use_fallback_features_;
+  }
+
   // This is used to store the mapping that was passed in to BuildMapping.
   BlockGraphMapping* mapping_;
 
   // This is used to store pending mappings.
   BlockGraphMapping pending_;
   BlockGraphMapping pending_reverse_;
+
+  // Set to true once the fallback features are in use.
+  bool use_fallback_features_;
 };
 
 bool BlockGraphMapper::BuildMapping(const BlockGraph& bg0,
@@ -653,21 +822,63 @@ bool BlockGraphMapper::BuildMapping(const BlockGraph& bg0,
   feature_indices_[kNameFeature].reset(
       new FeatureIndex(name_feature, bg0, bg1));
 #endif
-
-  // Iterate through each index.
+  BlockShapeFeature shape_feature;
+  feature_indices_[kShapeFeature].reset(
+      new FeatureIndex(shape_feature, bg0, bg1));
+
+  // Iterate through each index. For every feature value we find that contains
+  // only a single block per block-graph, we can infer that these blocks are
+  // identical. Use these as a root for matching up blocks.
+  use_fallback_features_ = false;
   for (size_t i = 0; i < kFeatureCount; ++i) {
-    // Iterate through the unique feature values. For every feature value we
-    // find that contains only a single block per block-graph, we can infer that
-    // these blocks are identical. Use these as a root for matching up blocks.
-    for (size_t j = 0; j < feature_indices_[i]->size(); ++j) {
-      if (feature_indices_[i]->ExistUniqueBlocks(j)) {
-        if (!ScheduleUniqueBucketMapping(i, j)) {
-          return false;
-        }
-      }
+    if (UseFeature(i) && !ScheduleUniqueBucketMappings(i))
+      return false;
+  }
+  if (!MapPendingBlocks())
+    return false;
+
+  // Once nothing more can be matched, fall back to matching the blocks that
+  // are merely similar. The resulting mappings are propagated as usual, and
+  // this is repeated for as long as it leads to new mappings.
+  use_fallback_features_ = true;
+  size_t mapped_blocks = 0;
+  while (mapping_->size() != mapped_blocks) {
+    mapped_blocks = mapping_->size();
+    for (size_t i = kShapeFeature; i < kFeatureCount; ++i) {
+      if (!ScheduleUniqueBucketMappings(i))
+        return false;
+    }
+    if (!MapPendingBlocks())
+      return false;
+  }
+  LOG(INFO) << "Mapped " << mapping_->size() << " blocks.";
+
+  // Forget the mapping output variable.
+  mapping_ = NULL;
+
+  // If provided, fill out the list of unmapped blocks.
+  if (unmapped0 != NULL)
+    feature_indices_[kHashFeature]->GetUnmappedBlocks(0, unmapped0);
+  if (unmapped1 != NULL)
+    feature_indices_[kHashFeature]->GetUnmappedBlocks(1, unmapped1);
+
+  return true;
+}
+
+bool BlockGraphMapper::ScheduleUniqueBucketMappings(size_t feature_id) {
+  DCHECK(UseFeature(feature_id));
+
+  for (size_t i = 0; i < feature_indices_[feature_id]->size(); ++i) {
+    if (feature_indices_[feature_id]->ExistUniqueBlocks(i)) {
+      if (!ScheduleUniqueBucketMapping(feature_id, i))
+        return false;
     }
   }
 
+  return true;
+}
+
+bool BlockGraphMapper::MapPendingBlocks() {
   // Loop until there are no more blocks left to map.
   while (!pending_.empty()) {
     const BlockGraph::Block* block0 = pending_.begin()->first;
@@ -681,23 +892,14 @@ bool BlockGraphMapper::BuildMapping(const BlockGraph& bg0,
   DCHECK(pending_.empty());
   DCHECK(pending_reverse_.empty());
 
-  // Forget the mapping output variable.
-  mapping_ = NULL;
-
-  // If provided, fill out the list of unmapped blocks.
-  if (unmapped0 != NULL)
-    feature_indices_[0]->GetUnmappedBlocks(0, unmapped0);
-  if (unmapped1 != NULL)
-    feature_indices_[0]->GetUnmappedBlocks(1, unmapped1);
-
   return true;
 }
 
 bool BlockGraphMapper::ScheduleMapping(const BlockGraph::Block* block0,
                                        const BlockGraph::Block* block1) {
   // Neither block should yet be mapped.
-  DCHECK(!feature_indices_[0]->BlockIsMapped(block0));
-  DCHECK(!feature_indices_[0]->BlockIsMapped(block1));
+  DCHECK(!feature_indices_[kHashFeature]->BlockIsMapped(block0));
+  DCHECK(!feature_indices_[kHashFeature]->BlockIsMapped(block1));
 
   // Use the pending_ and pending_reverse_ to ensure that neither of these
   // blocks are already scheduled for mapping. If they are, then we ignore
@@ -778,11 +980,19 @@ bool BlockGraphMapper::MapBlocks(const BlockGraph::Block* block0,
   // Map the blocks in each feature. If the mapping causes any other feature
   // buckets to become unique, pursue those as well.
   for (size_t i = 0; i < kFeatureCount; ++i) {
+    if (feature_indices_[i] == NULL)
+      continue;
+
     size_t unique_bucket0 = FeatureIndex::kInvalidFeatureBucket;
     size_t unique_bucket1 = FeatureIndex::kInvalidFeatureBucket;
     feature_indices_[i]->MarkAsMapped(block0, block1,
         &unique_bucket0, &unique_bucket1);
 
+    // The fallback features must be kept up to date, but are only used to
+    // make matches when enabled.
+    if (!UseFeature(i))
+      continue;
+
     if (unique_bucket0 != FeatureIndex::kInvalidFeatureBucket) {
       if (!ScheduleUniqueBucketMapping(i, unique_bucket0))
         return false;
@@ -884,8 +1094,8 @@ bool BlockGraphMapper::ScheduleReferrerMappings(const BlockGraph::Block* block0,
 bool BlockGraphMapper::ScheduleIfUnmapped(const BlockGraph::Block* block0,
                                           const BlockGraph::Block* block1) {
   // Schedule the blocks for mapping if they arent
-  if (feature_indices_[0]->BlockIsMapped(block0) ||
-      feature_indices_[0]->BlockIsMapped(block1))
+  if (feature_indices_[kHashFeature]->BlockIsMapped(block0) ||
+      feature_indices_[kHashFeature]->BlockIsMapped(block1))
     return true;
 
   return ScheduleMapping(block0, block1);
@@ -0,0 +1,56 @@
+# Copyright 2013 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+{
+  'variables': {
+    'chromium_code': 1,
+  },
+  'targets': [
+    {
+      'target_name': 'decompose_benchmark_lib',
+      'type': 'static_library',
+      'sources': [
+        'decompose_benchmark_app.cc',
+        'decompose_benchmark_app.h',
+      ],
+      'dependencies': [
+        '<(src)/syzygy/block_graph/block_graph.gyp:block_graph_lib',
+        '<(src)/syzygy/common/common.gyp:stage_profiler_lib',
+        '<(src)/syzygy/common/common.gyp:syzygy_version',
+        '<(src)/syzygy/core/core.gyp:core_lib',
+        '<(src)/syzygy/instrument/instrument.gyp:instrument_lib',
+        '<(src)/syzygy/pe/pe.gyp:pe_lib',
+      ],
+    },
+    {
+      'target_name': 'decompose_benchmark',
+      'type': 'executable',
+      'sources': [
+        'decompose_benchmark_main.cc',
+      ],
+      'dependencies': [
+        'decompose_benchmark_lib',
+      ],
+      'run_as': {
+        'action': [
+          '$(TargetPath)',
+          '--iterations=5',
+          '--output=$(OutDir)\\decompose_benchmark_for_test_dll.json',
+          '--pretty-print',
+          '$(OutDir)\\test_dll.dll',
+        ],
+      },
+    },
+  ],
+}
@@ -0,0 +1,599 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Benchmarks the decomposers and the block-graph serializer over a corpus of
+// images.
+
+#include "syzygy/experimental/decompose_benchmark/decompose_benchmark_app.h"
+
+#include <crtdbg.h>
+#include <windows.h>  // NOLINT
+
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <utility>
+
+#include "base/file_util.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/string_number_conversions.h"
+#include "base/string_split.h"
+#include "base/utf_string_conversions.h"
+#include "syzygy/block_graph/basic_block_decomposer.h"
+#include "syzygy/block_graph/basic_block_subgraph.h"
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/block_graph/transform.h"
+#include "syzygy/common/stage_profiler.h"
+#include "syzygy/core/json_file_writer.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/instrument/transforms/asan_transform.h"
+#include "syzygy/pe/decomposer.h"
+#include "syzygy/pe/new_decomposer.h"
+#include "syzygy/pe/pe_file.h"
+#include "syzygy/pe/pe_transform_policy.h"
+#include "syzygy/pe/serialization.h"
+
+namespace experimental {
+
+namespace {
+
+using block_graph::BasicBlockDecomposer;
+using block_graph::BasicBlockSubGraph;
+using block_graph::BlockGraph;
+using block_graph::BlockGraphSerializer;
+using common::StageProfiler;
+
+const char kUsageFormatStr[] =
+    "Usage: %ls [options] IMAGE_FILE [IMAGE_FILE ...]\n"
+    "\n"
+    "  A tool that benchmarks the decomposers and the block-graph serializer\n"
+    "  over a corpus of images, and reports their throughput and memory\n"
+    "  usage as JSON.\n"
+    "\n"
+    "Optional parameters:\n"
+    "  --benchmarks=LIST    A comma separated list of the benchmarks to run.\n"
+    "                       Defaults to all of them: decomposer,\n"
+    "                       new-decomposer, basic-block-decomposer,\n"
+    "                       asan-transform, reference-rewrite,\n"
+    "                       serializer-save and serializer-load.\n"
+    "  --iterations=NUM     The number of times to run each benchmark over\n"
+    "                       each image. Defaults to 5.\n"
+    "  --output=PATH        The path to which the JSON results should be\n"
+    "                       written. Defaults to stdout.\n"
+    "  --pretty-print       Pretty-prints the JSON output.\n"
+    "\n"
+    "  Each result records the storage of the block references, referrers\n"
+    "  and labels the tool was built with: 'node' or 'flat' (see the\n"
+    "  flat_block_containers gyp variable). Comparing the results of both\n"
+    "  builds gives the memory and throughput of the two layouts.\n";
+
+const int kDefaultIterations = 5;
+
+// The storage of the references, referrers and labels of the blocks.
+#if defined(SYZYGY_FLAT_BLOCK_CONTAINERS)
+const char kBlockContainers[] = "flat";
+#else
+const char kBlockContainers[] = "node";
+#endif
+
+#ifdef _DEBUG
+// The number of heap allocations seen by AllocationCountingHook. This is only
+// ever modified with interlocked operations.
+volatile LONG allocation_count = 0;
+
+int __cdecl AllocationCountingHook(int alloc_type,
+                                   void* /* user_data */,
+                                   size_t /* size */,
+                                   int /* block_type */,
+                                   long /* request_number */,
+                                   const unsigned char* /* file_name */,
+                                   int /* line_number */) {
+  if (alloc_type == _HOOK_ALLOC || alloc_type == _HOOK_REALLOC)
+    ::InterlockedIncrement(&allocation_count);
+  return TRUE;
+}
+#endif
+
+double ToMegabytes(size_t bytes) {
+  return static_cast<double>(bytes) / (1024 * 1024);
+}
+
+}  // namespace
+
+// The image being benchmarked, with the state shared by the benchmarks.
+struct DecomposeBenchmarkApp::ImageContext {
+  ImageContext() : image_layout(&block_graph), image_size(0) {
+  }
+
+  base::FilePath image_path;
+  pe::PEFile pe_file;
+
+  // A decomposition of the image, for the benchmarks that start from one.
+  BlockGraph block_graph;
+  pe::ImageLayout image_layout;
+
+  // The serialized decomposition, for the serializer-load benchmark.
+  std::vector<uint8> serialized;
+
+  // The size of the image file.
+  size_t image_size;
+};
+
+// Measures the work done over its lifetime, or until it's stopped, into a
+// sample. The memory usage is measured while the results of the work are
+// still alive.
+class DecomposeBenchmarkApp::ScopedSampleTimer {
+ public:
+  explicit ScopedSampleTimer(Sample* sample)
+      : sample_(sample), stopped_(false) {
+    DCHECK(sample != NULL);
+    StageProfiler::GetMemoryUsage(&start_usage_);
+#ifdef _DEBUG
+    allocation_count = 0;
+    previous_hook_ = _CrtSetAllocHook(&AllocationCountingHook);
+#endif
+    start_time_ = base::TimeTicks::HighResNow();
+  }
+
+  ~ScopedSampleTimer() {
+    Stop();
+  }
+
+  void Stop() {
+    if (stopped_)
+      return;
+    stopped_ = true;
+
+    sample_->duration = base::TimeTicks::HighResNow() - start_time_;
+#ifdef _DEBUG
+    _CrtSetAllocHook(previous_hook_);
+    sample_->allocations = allocation_count;
+#endif
+
+    StageProfiler::MemoryUsage end_usage;
+    StageProfiler::GetMemoryUsage(&end_usage);
+    if (end_usage.private_bytes > start_usage_.private_bytes) {
+      sample_->private_bytes_growth =
+          end_usage.private_bytes - start_usage_.private_bytes;
+    }
+  }
+
+ private:
+  Sample* sample_;
+  bool stopped_;
+  base::TimeTicks start_time_;
+  StageProfiler::MemoryUsage start_usage_;
+#ifdef _DEBUG
+  _CRT_ALLOC_HOOK previous_hook_;
+#endif
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedSampleTimer);
+};
+
+const DecomposeBenchmarkApp::Benchmark DecomposeBenchmarkApp::kBenchmarks[] = {
+    { "decomposer", &DecomposeBenchmarkApp::RunDecomposer },
+    { "new-decomposer", &DecomposeBenchmarkApp::RunNewDecomposer },
+    { "basic-block-decomposer",
+      &DecomposeBenchmarkApp::RunBasicBlockDecomposer },
+    { "asan-transform", &DecomposeBenchmarkApp::RunAsanTransform },
+    { "reference-rewrite", &DecomposeBenchmarkApp::RunReferenceRewrite },
+    { "serializer-save", &DecomposeBenchmarkApp::RunSerializerSave },
+    { "serializer-load", &DecomposeBenchmarkApp::RunSerializerLoad },
+};
+
+DecomposeBenchmarkApp::DecomposeBenchmarkApp()
+    : common::AppImplBase("Decomposition Benchmark"),
+      num_iterations_(kDefaultIterations),
+      pretty_print_(false) {
+}
+
+void DecomposeBenchmarkApp::PrintUsage(const base::FilePath& program,
+                                       const base::StringPiece& message) {
+  if (!message.empty()) {
+    ::fwrite(message.data(), 1, message.length(), out());
+    ::fprintf(out(), "\n\n");
+  }
+
+  ::fprintf(out(), kUsageFormatStr, program.BaseName().value().c_str());
+}
+
+bool DecomposeBenchmarkApp::ParseCommandLine(const CommandLine* cmd_line) {
+  DCHECK(cmd_line != NULL);
+
+  if (cmd_line->HasSwitch("help")) {
+    PrintUsage(cmd_line->GetProgram(), "");
+    return false;
+  }
+
+  const CommandLine::StringVector& args = cmd_line->GetArgs();
+  for (size_t i = 0; i < args.size(); ++i)
+    image_paths_.push_back(AbsolutePath(base::FilePath(args[i])));
+  if (image_paths_.empty()) {
+    PrintUsage(cmd_line->GetProgram(), "Must specify at least one image.");
+    return false;
+  }
+
+  if (cmd_line->HasSwitch("benchmarks")) {
+    std::vector<std::string> names;
+    base::SplitString(cmd_line->GetSwitchValueASCII("benchmarks"), ',',
+                      &names);
+    for (size_t i = 0; i < names.size(); ++i) {
+      const Benchmark* benchmark = NULL;
+      for (size_t j = 0; j < arraysize(kBenchmarks); ++j) {
+        if (names[i] == kBenchmarks[j].name) {
+          benchmark = &kBenchmarks[j];
+          break;
+        }
+      }
+      if (benchmark == NULL) {
+        PrintUsage(cmd_line->GetProgram(),
+                   "Unknown benchmark '" + names[i] + "'.");
+        return false;
+      }
+      benchmarks_.push_back(benchmark);
+    }
+  } else {
+    for (size_t i = 0; i < arraysize(kBenchmarks); ++i)
+      benchmarks_.push_back(&kBenchmarks[i]);
+  }
+  if (benchmarks_.empty()) {
+    PrintUsage(cmd_line->GetProgram(), "Must specify at least one benchmark.");
+    return false;
+  }
+
+  if (cmd_line->HasSwitch("iterations") &&
+      (!base::StringToInt(cmd_line->GetSwitchValueASCII("iterations"),
+                          &num_iterations_) ||
+       num_iterations_ <= 0)) {
+    PrintUsage(cmd_line->GetProgram(), "Must specify '--iterations' >= 1!");
+    return false;
+  }
+
+  output_path_ = AbsolutePath(cmd_line->GetSwitchValuePath("output"));
+  pretty_print_ = cmd_line->HasSwitch("pretty-print");
+
+  return true;
+}
+
+int DecomposeBenchmarkApp::Run() {
+  DCHECK(!image_paths_.empty());
+  DCHECK(!benchmarks_.empty());
+  DCHECK_LT(0, num_iterations_);
+
+  file_util::ScopedFILE output_file;
+  FILE* output = out();
+  if (!output_path_.empty()) {
+    output_file.reset(file_util::OpenFile(output_path_, "wb"));
+    if (output_file.get() == NULL) {
+      LOG(ERROR) << "Failed to open " << output_path_.value()
+                 << " for writing.";
+      return 1;
+    }
+    output = output_file.get();
+  }
+
+  core::JSONFileWriter json(output, pretty_print_);
+  if (!json.OpenList())
+    return 1;
+
+  for (size_t i = 0; i < image_paths_.size(); ++i) {
+    LOG(INFO) << "Processing \"" << image_paths_[i].value() << "\".";
+
+    // The decomposition and its serialization are computed once per image,
+    // for the benchmarks which start from them.
+    ImageContext context;
+    context.image_path = image_paths_[i];
+    int64 image_size = 0;
+    if (!file_util::GetFileSize(context.image_path, &image_size) ||
+        !context.pe_file.Init(context.image_path)) {
+      LOG(ERROR) << "Failed to read " << context.image_path.value() << ".";
+      return 1;
+    }
+    context.image_size = static_cast<size_t>(image_size);
+
+    pe::Decomposer decomposer(context.pe_file);
+    if (!decomposer.Decompose(&context.image_layout))
+      return 1;
+
+    scoped_ptr<core::OutStream> out_stream(
+        core::CreateByteOutStream(std::back_inserter(context.serialized)));
+    core::NativeBinaryOutArchive out_archive(out_stream.get());
+    if (!pe::SaveBlockGraphAndImageLayout(
+            context.pe_file, BlockGraphSerializer::DEFAULT_ATTRIBUTES,
+            context.image_layout, &out_archive) ||
+        !out_archive.Flush()) {
+      LOG(ERROR) << "Failed to serialize the decomposition of "
+                 << context.image_path.value() << ".";
+      return 1;
+    }
+
+    for (size_t j = 0; j < benchmarks_.size(); ++j) {
+      if (!RunBenchmark(*benchmarks_[j], &context, &json))
+        return 1;
+    }
+  }
+
+  if (!json.CloseList() || !json.Flush())
+    return 1;
+
+  return 0;
+}
+
+bool DecomposeBenchmarkApp::RunBenchmark(const Benchmark& benchmark,
+                                         ImageContext* context,
+                                         core::JSONFileWriter* json) {
+  DCHECK(context != NULL);
+  DCHECK(json != NULL);
+
+  LOG(INFO) << "Running the " << benchmark.name << " benchmark.";
+
+  base::TimeDelta min_time;
+  base::TimeDelta total_time;
+  size_t total_bytes = 0;
+  size_t total_blocks = 0;
+  size_t total_allocations = 0;
+  size_t max_private_bytes_growth = 0;
+  for (int i = 0; i < num_iterations_; ++i) {
+    Sample sample;
+    if (!(*benchmark.function)(context, &sample)) {
+      LOG(ERROR) << "The " << benchmark.name << " benchmark failed on "
+                 << context->image_path.value() << ".";
+      return false;
+    }
+
+    if (i == 0 || sample.duration < min_time)
+      min_time = sample.duration;
+    total_time += sample.duration;
+    total_bytes += sample.bytes;
+    total_blocks += sample.blocks;
+    total_allocations += sample.allocations;
+    max_private_bytes_growth = std::max(max_private_bytes_growth,
+                                        sample.private_bytes_growth);
+  }
+
+  StageProfiler::MemoryUsage usage;
+  StageProfiler::GetMemoryUsage(&usage);
+
+  double total_seconds = std::max(total_time.InSecondsF(), 1e-9);
+  double mean_time_ms = total_time.InMillisecondsF() / num_iterations_;
+  double megabytes_per_second = ToMegabytes(total_bytes) / total_seconds;
+  double blocks_per_second = total_blocks / total_seconds;
+
+  LOG(INFO) << benchmark.name << ": " << mean_time_ms << " ms, "
+            << megabytes_per_second << " MB/s, " << blocks_per_second
+            << " blocks/s.";
+
+  std::string image_path(WideToUTF8(context->image_path.value()));
+  bool success = json->OpenDict() &&
+      json->OutputKey("image") && json->OutputString(image_path) &&
+      json->OutputKey("benchmark") && json->OutputString(benchmark.name) &&
+      json->OutputKey("block_containers") &&
+      json->OutputString(kBlockContainers) &&
+      json->OutputKey("iterations") && json->OutputInteger(num_iterations_) &&
+      json->OutputKey("image_size") &&
+      json->OutputInteger(static_cast<int>(context->image_size)) &&
+      json->OutputKey("min_time_ms") &&
+      json->OutputDouble(min_time.InMillisecondsF()) &&
+      json->OutputKey("mean_time_ms") && json->OutputDouble(mean_time_ms) &&
+      json->OutputKey("megabytes_per_second") &&
+      json->OutputDouble(megabytes_per_second) &&
+      json->OutputKey("blocks_per_second") &&
+      json->OutputDouble(blocks_per_second) &&
+      json->OutputKey("allocations");
+#ifdef _DEBUG
+  success = success && json->OutputInteger(
+      static_cast<int>(total_allocations / num_iterations_));
+#else
+  // The allocations are only counted in debug builds.
+  success = success && json->OutputNull();
+#endif
+  success = success &&
+      json->OutputKey("peak_working_set") &&
+      json->OutputInteger(static_cast<int>(usage.peak_working_set)) &&
+      json->OutputKey("max_private_bytes_growth") &&
+      json->OutputInteger(static_cast<int>(max_private_bytes_growth)) &&
+      json->CloseDict();
+
+  return success;
+}
+
+bool DecomposeBenchmarkApp::RunDecomposer(ImageContext* context,
+                                          Sample* sample) {
+  DCHECK(context != NULL);
+  DCHECK(sample != NULL);
+
+  BlockGraph block_graph;
+  pe::ImageLayout image_layout(&block_graph);
+  pe::Decomposer decomposer(context->pe_file);
+
+  ScopedSampleTimer timer(sample);
+  if (!decomposer.Decompose(&image_layout))
+    return false;
+  timer.Stop();
+
+  sample->bytes = context->image_size;
+  sample->blocks = block_graph.blocks().size();
+  return true;
+}
+
+bool DecomposeBenchmarkApp::RunNewDecomposer(ImageContext* context,
+                                             Sample* sample) {
+  DCHECK(context != NULL);
+  DCHECK(sample != NULL);
+
+  BlockGraph block_graph;
+  pe::ImageLayout image_layout(&block_graph);
+  pe::NewDecomposer decomposer(context->pe_file);
+
+  ScopedSampleTimer timer(sample);
+  if (!decomposer.Decompose(&image_layout))
+    return false;
+  timer.Stop();
+
+  sample->bytes = context->image_size;
+  sample->blocks = block_graph.blocks().size();
+  return true;
+}
+
+bool DecomposeBenchmarkApp::RunBasicBlockDecomposer(ImageContext* context,
+                                                    Sample* sample) {
+  DCHECK(context != NULL);
+  DCHECK(sample != NULL);
+
+  pe::PETransformPolicy policy;
+  const BlockGraph::BlockMap& blocks = context->block_graph.blocks();
+
+  // Only the code blocks which are safe to decompose are measured.
+  ScopedSampleTimer timer(sample);
+  BlockGraph::BlockMap::const_iterator it = blocks.begin();
+  for (; it != blocks.end(); ++it) {
+    const BlockGraph::Block* block = &it->second;
+    if (!policy.CodeBlockIsSafeToBasicBlockDecompose(block))
+      continue;
+
+    BasicBlockSubGraph subgraph;
+    BasicBlockDecomposer decomposer(block, &subgraph);
+    if (!decomposer.Decompose())
+      return false;
+
+    sample->bytes += block->size();
+    ++sample->blocks;
+  }
+  timer.Stop();
+
+  return true;
+}
+
+bool DecomposeBenchmarkApp::RunAsanTransform(ImageContext* context,
+                                             Sample* sample) {
+  DCHECK(context != NULL);
+  DCHECK(sample != NULL);
+
+  // The transform modifies the image, so it runs over a fresh decomposition.
+  BlockGraph block_graph;
+  pe::ImageLayout image_layout(&block_graph);
+  pe::Decomposer decomposer(context->pe_file);
+  if (!decomposer.Decompose(&image_layout))
+    return false;
+  BlockGraph::Block* dos_header_block =
+      image_layout.blocks.GetBlockByAddress(core::RelativeAddress(0));
+  if (dos_header_block == NULL)
+    return false;
+
+  // Configured as the instrumenter does by default. Each safe code block goes
+  // through a basic-block decomposition, the AsanBasicBlockTransform and a
+  // merge back into the image.
+  instrument::transforms::AsanTransform asan_transform;
+  asan_transform.set_use_liveness_analysis(true);
+  asan_transform.set_remove_redundant_checks(true);
+  pe::PETransformPolicy policy;
+  size_t num_blocks = block_graph.blocks().size();
+
+  ScopedSampleTimer timer(sample);
+  if (!block_graph::ApplyBlockGraphTransform(&asan_transform, &policy,
+                                             &block_graph, dos_header_block)) {
+    return false;
+  }
+  timer.Stop();
+
+  sample->bytes = context->image_size;
+  sample->blocks = num_blocks;
+  return true;
+}
+
+bool DecomposeBenchmarkApp::RunReferenceRewrite(ImageContext* context,
+                                                Sample* sample) {
+  DCHECK(context != NULL);
+  DCHECK(sample != NULL);
+
+  BlockGraph::BlockMap& blocks = context->block_graph.blocks_mutable();
+  std::vector<std::pair<BlockGraph::Offset, BlockGraph::Reference> >
+      references;
+
+  // Every reference is removed and set back, as a transform retargeting all
+  // of them would. This churns the references of each block and the
+  // referrers of the blocks they point to, and leaves the graph as it was.
+  ScopedSampleTimer timer(sample);
+  BlockGraph::BlockMap::iterator it = blocks.begin();
+  for (; it != blocks.end(); ++it) {
+    BlockGraph::Block* block = &it->second;
+    references.assign(block->references().begin(),
+                      block->references().end());
+    for (size_t i = 0; i < references.size(); ++i) {
+      if (!block->RemoveReference(references[i].first))
+        return false;
+    }
+    for (size_t i = 0; i < references.size(); ++i) {
+      if (!block->SetReference(references[i].first, references[i].second))
+        return false;
+    }
+
+    sample->bytes += block->size();
+    ++sample->blocks;
+  }
+  timer.Stop();
+
+  return true;
+}
+
+bool DecomposeBenchmarkApp::RunSerializerSave(ImageContext* context,
+                                              Sample* sample) {
+  DCHECK(context != NULL);
+  DCHECK(sample != NULL);
+
+  std::vector<uint8> serialized;
+  serialized.reserve(context->serialized.size());
+  scoped_ptr<core::OutStream> out_stream(
+      core::CreateByteOutStream(std::back_inserter(serialized)));
+  core::NativeBinaryOutArchive out_archive(out_stream.get());
+
+  ScopedSampleTimer timer(sample);
+  if (!pe::SaveBlockGraphAndImageLayout(
+          context->pe_file, BlockGraphSerializer::DEFAULT_ATTRIBUTES,
+          context->image_layout, &out_archive) ||
+      !out_archive.Flush()) {
+    return false;
+  }
+  timer.Stop();
+
+  sample->bytes = serialized.size();
+  sample->blocks = context->block_graph.blocks().size();
+  return true;
+}
+
+bool DecomposeBenchmarkApp::RunSerializerLoad(ImageContext* context,
+                                              Sample* sample) {
+  DCHECK(context != NULL);
+  DCHECK(sample != NULL);
+
+  BlockGraph block_graph;
+  pe::ImageLayout image_layout(&block_graph);
+  scoped_ptr<core::InStream> in_stream(core::CreateByteInStream(
+      context->serialized.begin(), context->serialized.end()));
+  core::NativeBinaryInArchive in_archive(in_stream.get());
+  BlockGraphSerializer::Attributes attributes = 0;
+
+  ScopedSampleTimer timer(sample);
+  if (!pe::LoadBlockGraphAndImageLayout(context->pe_file, &attributes,
+                                        &image_layout, &in_archive)) {
+    return false;
+  }
+  timer.Stop();
+
+  sample->bytes = context->serialized.size();
+  sample->blocks = block_graph.blocks().size();
+  return true;
+}
+
+}  // namespace experimental
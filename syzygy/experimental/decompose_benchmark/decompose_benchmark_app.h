@@ -0,0 +1,131 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the application class of the decompose_benchmark tool, which
+// measures the throughput and the memory usage of the decomposers and of the
+// block-graph serializer over a corpus of images.
+
+#ifndef SYZYGY_EXPERIMENTAL_DECOMPOSE_BENCHMARK_DECOMPOSE_BENCHMARK_APP_H_
+#define SYZYGY_EXPERIMENTAL_DECOMPOSE_BENCHMARK_DECOMPOSE_BENCHMARK_APP_H_
+
+#include <vector>
+
+#include "base/command_line.h"
+#include "base/time.h"
+#include "base/files/file_path.h"
+#include "syzygy/common/application.h"
+
+namespace core {
+
+// Forward declaration.
+class JSONFileWriter;
+
+}  // namespace core
+
+namespace experimental {
+
+// This class implements the decompose_benchmark command-line utility.
+//
+// See the description given in kUsageFormatStr for information about running
+// this utility.
+class DecomposeBenchmarkApp : public common::AppImplBase {
+ public:
+  DecomposeBenchmarkApp();
+
+  // @name Implementation of the AppImplBase interface.
+  // @{
+  bool ParseCommandLine(const CommandLine* command_line);
+
+  int Run();
+  // @}
+
+ protected:
+  // Forward declarations.
+  struct ImageContext;
+  class ScopedSampleTimer;
+
+  // The measurements of a single iteration of a benchmark.
+  struct Sample {
+    Sample()
+        : bytes(0), blocks(0), allocations(0), private_bytes_growth(0) {
+    }
+
+    // The time spent in the measured work.
+    base::TimeDelta duration;
+    // The number of bytes and of blocks processed by the measured work.
+    size_t bytes;
+    size_t blocks;
+    // The number of heap allocations made by the measured work. This is only
+    // counted in debug builds.
+    size_t allocations;
+    // The growth of the private bytes of the process over the measured work.
+    size_t private_bytes_growth;
+  };
+
+  // The function running a single iteration of a benchmark.
+  // @param context The image to run over.
+  // @param sample Receives the measurements of the iteration.
+  // @returns true on success, false otherwise.
+  typedef bool (*BenchmarkFunction)(ImageContext* context, Sample* sample);
+
+  // A benchmark, by name.
+  struct Benchmark {
+    const char* name;
+    BenchmarkFunction function;
+  };
+  typedef std::vector<const Benchmark*> BenchmarkVector;
+
+  // The available benchmarks.
+  static const Benchmark kBenchmarks[];
+
+  // Print the app's usage information.
+  void PrintUsage(const base::FilePath& program,
+                  const base::StringPiece& message);
+
+  // Runs a benchmark over an image, and writes its results.
+  // @param benchmark The benchmark to run.
+  // @param context The image to run over.
+  // @param json The writer receiving the results.
+  // @returns true on success, false otherwise.
+  bool RunBenchmark(const Benchmark& benchmark,
+                    ImageContext* context,
+                    core::JSONFileWriter* json);
+
+  // @name The benchmarks.
+  // @{
+  static bool RunDecomposer(ImageContext* context, Sample* sample);
+  static bool RunNewDecomposer(ImageContext* context, Sample* sample);
+  static bool RunBasicBlockDecomposer(ImageContext* context, Sample* sample);
+  static bool RunAsanTransform(ImageContext* context, Sample* sample);
+  static bool RunReferenceRewrite(ImageContext* context, Sample* sample);
+  static bool RunSerializerSave(ImageContext* context, Sample* sample);
+  static bool RunSerializerLoad(ImageContext* context, Sample* sample);
+  // @}
+
+  // @name Command-line options.
+  // @{
+  std::vector<base::FilePath> image_paths_;
+  BenchmarkVector benchmarks_;
+  base::FilePath output_path_;
+  int num_iterations_;
+  bool pretty_print_;
+  // @}
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(DecomposeBenchmarkApp);
+};
+
+}  // namespace experimental
+
+#endif  // SYZYGY_EXPERIMENTAL_DECOMPOSE_BENCHMARK_DECOMPOSE_BENCHMARK_APP_H_
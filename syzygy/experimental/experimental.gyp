@@ -23,6 +23,8 @@
       'dependencies': [
         '<(src)/syzygy/experimental/code_tally/code_tally.gyp:*',
         '<(src)/syzygy/experimental/compare/compare.gyp:*',
+        '<(src)/syzygy/experimental/decompose_benchmark/decompose_benchmark.gyp:*',
+        '<(src)/syzygy/experimental/json_benchmark/json_benchmark.gyp:*',
         '<(src)/syzygy/experimental/pdb_dumper/pdb_dumper.gyp:*',
         '<(src)/syzygy/experimental/timed_decomposer/timed_decomposer.gyp:*',
       ],
@@ -0,0 +1,51 @@
+# Copyright 2013 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+{
+  'variables': {
+    'chromium_code': 1,
+  },
+  'targets': [
+    {
+      'target_name': 'json_benchmark_lib',
+      'type': 'static_library',
+      'sources': [
+        'json_benchmark_app.cc',
+        'json_benchmark_app.h',
+      ],
+      'dependencies': [
+        '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/common/common.gyp:syzygy_version',
+        '<(src)/syzygy/core/core.gyp:core_lib',
+      ],
+    },
+    {
+      'target_name': 'json_benchmark',
+      'type': 'executable',
+      'sources': [
+        'json_benchmark_main.cc',
+      ],
+      'dependencies': [
+        'json_benchmark_lib',
+      ],
+      'run_as': {
+        'action': [
+          '$(TargetPath)',
+          '--entries=1000000',
+          '--iterations=5',
+        ],
+      },
+    },
+  ],
+}
@@ -0,0 +1,210 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Benchmarks core::JSONFileWriter on large outputs.
+
+#include "syzygy/experimental/json_benchmark/json_benchmark_app.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "base/file_util.h"
+#include "base/string_number_conversions.h"
+#include "base/stringprintf.h"
+#include "syzygy/core/json_file_writer.h"
+
+namespace experimental {
+
+namespace {
+
+const char kUsageFormatStr[] =
+    "Usage: %ls [options]\n"
+    "\n"
+    "  A tool that measures how fast JSON output is written, in compact and\n"
+    "  in pretty-printed form. The output is a list of dictionaries, similar\n"
+    "  to an order file. The results are reported as JSON on stdout.\n"
+    "\n"
+    "Optional parameters:\n"
+    "  --entries=NUM        The number of entries in the output. Defaults to\n"
+    "                       1000000.\n"
+    "  --iterations=NUM     The number of times to write the output in each\n"
+    "                       form. Defaults to 5.\n";
+
+const int kDefaultEntries = 1000000;
+const int kDefaultIterations = 5;
+
+// The number of distinct entry names. They are formatted ahead of time so as
+// not to measure their formatting.
+const size_t kNameCount = 64;
+
+double ToMegabytes(size_t bytes) {
+  return static_cast<double>(bytes) / (1024 * 1024);
+}
+
+}  // namespace
+
+JSONBenchmarkApp::JSONBenchmarkApp()
+    : common::AppImplBase("JSON Benchmark"),
+      num_entries_(kDefaultEntries),
+      num_iterations_(kDefaultIterations) {
+}
+
+void JSONBenchmarkApp::PrintUsage(const base::FilePath& program,
+                                  const base::StringPiece& message) {
+  if (!message.empty()) {
+    ::fwrite(message.data(), 1, message.length(), out());
+    ::fprintf(out(), "\n\n");
+  }
+
+  ::fprintf(out(), kUsageFormatStr, program.BaseName().value().c_str());
+}
+
+bool JSONBenchmarkApp::ParseCommandLine(const CommandLine* cmd_line) {
+  DCHECK(cmd_line != NULL);
+
+  if (cmd_line->HasSwitch("help")) {
+    PrintUsage(cmd_line->GetProgram(), "");
+    return false;
+  }
+
+  if (cmd_line->HasSwitch("entries") &&
+      (!base::StringToInt(cmd_line->GetSwitchValueASCII("entries"),
+                          &num_entries_) ||
+       num_entries_ <= 0)) {
+    PrintUsage(cmd_line->GetProgram(), "Must specify '--entries' >= 1!");
+    return false;
+  }
+
+  if (cmd_line->HasSwitch("iterations") &&
+      (!base::StringToInt(cmd_line->GetSwitchValueASCII("iterations"),
+                          &num_iterations_) ||
+       num_iterations_ <= 0)) {
+    PrintUsage(cmd_line->GetProgram(), "Must specify '--iterations' >= 1!");
+    return false;
+  }
+
+  return true;
+}
+
+int JSONBenchmarkApp::Run() {
+  DCHECK_LT(0, num_entries_);
+  DCHECK_LT(0, num_iterations_);
+
+  base::FilePath temp_path;
+  if (!file_util::CreateTemporaryFile(&temp_path)) {
+    LOG(ERROR) << "Failed to create a temporary file.";
+    return 1;
+  }
+
+  core::JSONFileWriter json(out(), true);
+  bool success = json.OpenList();
+
+  for (int pretty_print = 0; success && pretty_print <= 1; ++pretty_print) {
+    const char* mode = pretty_print ? "pretty-print" : "compact";
+    LOG(INFO) << "Writing " << num_entries_ << " entries in " << mode
+              << " form.";
+
+    base::TimeDelta min_time;
+    base::TimeDelta total_time;
+    size_t bytes = 0;
+    for (int i = 0; success && i < num_iterations_; ++i) {
+      base::TimeDelta duration;
+      success = WriteDocument(temp_path, pretty_print != 0, &duration, &bytes);
+      if (i == 0 || duration < min_time)
+        min_time = duration;
+      total_time += duration;
+    }
+    if (!success)
+      break;
+
+    double mean_time_ms = total_time.InMillisecondsF() / num_iterations_;
+    double megabytes_per_second = ToMegabytes(bytes) * num_iterations_ /
+        std::max(total_time.InSecondsF(), 1e-9);
+
+    LOG(INFO) << mode << ": " << mean_time_ms << " ms, "
+              << megabytes_per_second << " MB/s.";
+
+    success = json.OpenDict() &&
+        json.OutputKey("mode") && json.OutputString(mode) &&
+        json.OutputKey("entries") && json.OutputInteger(num_entries_) &&
+        json.OutputKey("iterations") && json.OutputInteger(num_iterations_) &&
+        json.OutputKey("bytes") &&
+        json.OutputInteger(static_cast<int>(bytes)) &&
+        json.OutputKey("min_time_ms") &&
+        json.OutputDouble(min_time.InMillisecondsF()) &&
+        json.OutputKey("mean_time_ms") && json.OutputDouble(mean_time_ms) &&
+        json.OutputKey("megabytes_per_second") &&
+        json.OutputDouble(megabytes_per_second) &&
+        json.CloseDict();
+  }
+
+  file_util::Delete(temp_path, false);
+
+  if (!success || !json.CloseList() || !json.Flush())
+    return 1;
+
+  return 0;
+}
+
+bool JSONBenchmarkApp::WriteDocument(const base::FilePath& path,
+                                     bool pretty_print,
+                                     base::TimeDelta* duration,
+                                     size_t* bytes) {
+  DCHECK(duration != NULL);
+  DCHECK(bytes != NULL);
+
+  std::vector<std::string> names(kNameCount);
+  for (size_t i = 0; i < names.size(); ++i)
+    names[i] = base::StringPrintf("block_%d", static_cast<int>(i));
+
+  file_util::ScopedFILE file(file_util::OpenFile(path, "wb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Failed to open " << path.value() << " for writing.";
+    return false;
+  }
+
+  base::TimeTicks start_time = base::TimeTicks::HighResNow();
+  {
+    core::JSONFileWriter json(file.get(), pretty_print);
+    if (!json.OpenList())
+      return false;
+    for (int i = 0; i < num_entries_; ++i) {
+      const std::string& name = names[i % names.size()];
+      if (!json.OpenDict() ||
+          !json.OutputKey("address") || !json.OutputInteger(i * 16) ||
+          !json.OutputKey("size") || !json.OutputInteger(16 + i % 64) ||
+          !json.OutputKey("name") || !json.OutputString(name) ||
+          !json.OutputKey("heat") || !json.OutputDouble(i / 3.0) ||
+          !json.OutputTrailingComment(name) ||
+          !json.CloseDict()) {
+        return false;
+      }
+    }
+    if (!json.CloseList() || !json.Flush())
+      return false;
+  }
+  if (::fflush(file.get()) != 0)
+    return false;
+  *duration = base::TimeTicks::HighResNow() - start_time;
+
+  long size = ::ftell(file.get());
+  if (size < 0)
+    return false;
+  *bytes = static_cast<size_t>(size);
+
+  return true;
+}
+
+}  // namespace experimental
@@ -0,0 +1,72 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the application class of the json_benchmark tool, which measures
+// how fast core::JSONFileWriter writes large outputs.
+
+#ifndef SYZYGY_EXPERIMENTAL_JSON_BENCHMARK_JSON_BENCHMARK_APP_H_
+#define SYZYGY_EXPERIMENTAL_JSON_BENCHMARK_JSON_BENCHMARK_APP_H_
+
+#include "base/command_line.h"
+#include "base/time.h"
+#include "base/files/file_path.h"
+#include "syzygy/common/application.h"
+
+namespace experimental {
+
+// This class implements the json_benchmark command-line utility.
+//
+// See the description given in kUsageFormatStr for information about running
+// this utility.
+class JSONBenchmarkApp : public common::AppImplBase {
+ public:
+  JSONBenchmarkApp();
+
+  // @name Implementation of the AppImplBase interface.
+  // @{
+  bool ParseCommandLine(const CommandLine* command_line);
+
+  int Run();
+  // @}
+
+ protected:
+  // Print the app's usage information.
+  void PrintUsage(const base::FilePath& program,
+                  const base::StringPiece& message);
+
+  // Writes a document similar to an order file, and measures the time it
+  // took.
+  // @param path The file to write to.
+  // @param pretty_print Whether to pretty-print the document.
+  // @param duration Receives the time spent writing the document.
+  // @param bytes Receives the size of the document.
+  // @returns true on success, false otherwise.
+  bool WriteDocument(const base::FilePath& path,
+                     bool pretty_print,
+                     base::TimeDelta* duration,
+                     size_t* bytes);
+
+  // @name Command-line options.
+  // @{
+  int num_entries_;
+  int num_iterations_;
+  // @}
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(JSONBenchmarkApp);
+};
+
+}  // namespace experimental
+
+#endif  // SYZYGY_EXPERIMENTAL_JSON_BENCHMARK_JSON_BENCHMARK_APP_H_
@@ -18,12 +18,15 @@
 
 #include "base/bind.h"
 #include "base/file_util.h"
+#include "base/memory/scoped_vector.h"
 #include "base/string_util.h"
 #include "base/stringprintf.h"
 #include "base/utf_string_conversions.h"
 #include "base/win/scoped_bstr.h"
+#include "base/threading/simple_thread.h"
 #include "base/win/scoped_com_initializer.h"
 #include "sawbuck/common/com_utils.h"
+#include "syzygy/core/closure_delegate.h"
 #include "syzygy/pe/dia_util.h"
 #include "syzygy/pe/find.h"
 
@@ -70,8 +73,70 @@ void TrimComment(std::string* s) {
   s->resize(comment_index);
 }
 
+// Returns true if @p pattern may refer to one of its groups, or to the
+// whole pattern. Such a pattern can't be embedded in a larger one without
+// changing its meaning.
+bool HasGroupReference(const std::string& pattern) {
+  for (size_t i = 0; i + 1 < pattern.size(); ++i) {
+    char c = pattern[i + 1];
+    if (pattern[i] == '\\') {
+      // Back references: \1, \g{1}, \g-1, \k<name>, etc.
+      if (::isdigit(c) || c == 'g' || c == 'k')
+        return true;
+      // Skip the escaped character.
+      ++i;
+      continue;
+    }
+
+    // Subroutine calls and recursion: (?1), (?+1), (?R), (?P>name), etc.
+    if (pattern[i] != '(' || c != '?' || i + 2 >= pattern.size())
+      continue;
+    char d = pattern[i + 2];
+    if (::isdigit(d) || d == 'R' || d == '&' || d == 'P')
+      return true;
+    if ((d == '+' || d == '-') && i + 3 < pattern.size() &&
+        ::isdigit(pattern[i + 3])) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
 }  // namespace
 
+// The symbol matches found by one crawl shard. Each shard sees every
+// compiland and public symbol, but only inspects those whose index is
+// congruent to its own index. The matched ranges are indexed the same way as
+// rules_by_type_, so that the shards share no mutable state.
+struct FilterCompiler::CrawlShard {
+  CrawlShard(size_t shard_index, size_t shard_count)
+      : shard_index(shard_index),
+        shard_count(shard_count),
+        compilands_seen(0),
+        public_symbols_seen(0),
+        succeeded(false) {
+  }
+
+  // Returns true if the symbol with index @p index belongs to this shard.
+  bool Owns(size_t index) const {
+    return index % shard_count == shard_index;
+  }
+
+  size_t shard_index;
+  size_t shard_count;
+
+  // The number of compilands and public symbols visited so far.
+  size_t compilands_seen;
+  size_t public_symbols_seen;
+
+  // The ranges matched by each rule, by rule type.
+  std::vector<RelativeAddressFilter> ranges[kRuleTypeCount];
+
+  // Set to true if the crawl was successful.
+  bool succeeded;
+};
+
 bool FilterCompiler::Init(const base::FilePath& image_path) {
   return Init(image_path, base::FilePath());
 }
@@ -250,21 +315,72 @@ bool FilterCompiler::CrawlSymbols() {
   if (rule_map_.empty())
     return true;
 
+  BuildCombinedRegexes();
+
+  // Set up the shards, each with an empty filter per rule.
+  Range extent(RelativeAddress(0), image_signature_.module_size);
+  ScopedVector<CrawlShard> shards;
+  for (size_t i = 0; i < crawl_threads_; ++i) {
+    shards.push_back(new CrawlShard(i, crawl_threads_));
+    for (size_t j = 0; j < kRuleTypeCount; ++j) {
+      shards[i]->ranges[j].resize(rules_by_type_[j].size(),
+                                  RelativeAddressFilter(extent));
+    }
+  }
+
+  if (shards.size() == 1) {
+    CrawlShardSymbols(shards[0]);
+  } else {
+    ScopedVector<core::ClosureDelegate> work;
+    for (size_t i = 0; i < shards.size(); ++i) {
+      work.push_back(new core::ClosureDelegate(
+          base::Bind(&FilterCompiler::CrawlShardSymbolsOnWorker,
+                     base::Unretained(this), shards[i])));
+    }
+
+    base::DelegateSimpleThreadPool pool("FilterCompiler",
+                                        static_cast<int>(shards.size()));
+    pool.Start();
+    for (size_t i = 0; i < work.size(); ++i)
+      pool.AddWork(work[i]);
+    pool.JoinAll();
+  }
+
+  // Merge the matches of all of the shards into the rules.
+  for (size_t i = 0; i < shards.size(); ++i) {
+    const CrawlShard* shard = shards[i];
+    if (!shard->succeeded)
+      return false;
+
+    for (size_t j = 0; j < kRuleTypeCount; ++j) {
+      for (size_t k = 0; k < rules_by_type_[j].size(); ++k) {
+        Rule* rule = rules_by_type_[j][k];
+        rule->ranges.Union(shard->ranges[j][k], &rule->ranges);
+      }
+    }
+  }
+
+  return true;
+}
+
+void FilterCompiler::CrawlShardSymbols(CrawlShard* shard) {
+  DCHECK(shard != NULL);
+
   base::win::ScopedComPtr<IDiaDataSource> data_source;
   if (!pe::CreateDiaSource(data_source.Receive()))
-    return false;
+    return;
 
   base::win::ScopedComPtr<IDiaSession> session;
   if (!pe::CreateDiaSession(pdb_path_, data_source, session.Receive()))
-    return false;
+    return;
 
   // Visit all compilands looking for symbols if we need to.
   if (!rules_by_type_[kFunctionRule].empty()) {
     pe::CompilandVisitor compiland_visitor(session);
     if (!compiland_visitor.VisitAllCompilands(
             base::Bind(&FilterCompiler::OnCompiland,
-                       base::Unretained(this)))) {
-      return false;
+                       base::Unretained(this), shard))) {
+      return;
     }
   }
 
@@ -276,18 +392,61 @@ bool FilterCompiler::CrawlSymbols() {
     if (FAILED(hr)) {
       LOG(ERROR) << "Failed to get the DIA global scope: "
                  << com::LogHr(hr) << ".";
-      return false;
+      return;
     }
 
     pe::ChildVisitor public_symbol_visitor(global, SymTagPublicSymbol);
     if (!public_symbol_visitor.VisitChildren(
             base::Bind(&FilterCompiler::OnPublicSymbol,
-                       base::Unretained(this)))) {
-      return false;
+                       base::Unretained(this), shard))) {
+      return;
     }
   }
 
-  return true;
+  shard->succeeded = true;
+}
+
+void FilterCompiler::CrawlShardSymbolsOnWorker(CrawlShard* shard) {
+  // DIA is used through COM, which must be initialized on each thread.
+  base::win::ScopedCOMInitializer com_initializer;
+  CrawlShardSymbols(shard);
+}
+
+void FilterCompiler::BuildCombinedRegexes() {
+  for (size_t i = 0; i < kRuleTypeCount; ++i) {
+    combined_regexes_[i].reset();
+
+    // A single rule is as cheap to match on its own.
+    const RulePointers& rules = rules_by_type_[i];
+    if (rules.size() < 2)
+      continue;
+
+    std::string pattern;
+    for (size_t j = 0; j < rules.size(); ++j) {
+      const std::string& rule_pattern = rules[j]->regex.pattern();
+      if (HasGroupReference(rule_pattern)) {
+        pattern.clear();
+        break;
+      }
+      if (!pattern.empty())
+        pattern.append(1, '|');
+      pattern.append("(?:");
+      pattern.append(rule_pattern);
+      pattern.append(1, ')');
+    }
+    if (pattern.empty())
+      continue;
+
+    // The rules are still matched individually if they don't combine into a
+    // valid regex.
+    scoped_ptr<RE> combined_regex(new RE(pattern));
+    if (!combined_regex->error().empty()) {
+      VLOG(1) << "Unable to combine the " << kRuleTypeStrings[i]
+              << " rules: " << combined_regex->error();
+      continue;
+    }
+    combined_regexes_[i].reset(combined_regex.release());
+  }
 }
 
 bool FilterCompiler::FillFilter(ImageFilter* filter) {
@@ -322,33 +481,47 @@ bool FilterCompiler::FillFilter(ImageFilter* filter) {
   return true;
 }
 
-bool FilterCompiler::OnCompiland(IDiaSymbol* compiland) {
+bool FilterCompiler::OnCompiland(CrawlShard* shard, IDiaSymbol* compiland) {
+  DCHECK(shard != NULL);
   DCHECK(compiland != NULL);
+  if (!shard->Owns(shard->compilands_seen++))
+    return true;
+
   pe::ChildVisitor function_visitor(compiland, SymTagFunction);
   if (!function_visitor.VisitChildren(
           base::Bind(&FilterCompiler::OnFunction,
-                     base::Unretained(this)))) {
+                     base::Unretained(this), shard))) {
     return false;
   }
   return true;
 }
 
-bool FilterCompiler::OnFunction(IDiaSymbol* function) {
+bool FilterCompiler::OnFunction(CrawlShard* shard, IDiaSymbol* function) {
+  DCHECK(shard != NULL);
   DCHECK(function != NULL);
-  if (!MatchRulesBySymbolName(rules_by_type_[kFunctionRule], function))
+  if (!MatchRulesBySymbolName(kFunctionRule, shard, function))
     return false;
   return true;
 }
 
-bool FilterCompiler::OnPublicSymbol(IDiaSymbol* public_symbol) {
+bool FilterCompiler::OnPublicSymbol(CrawlShard* shard,
+                                    IDiaSymbol* public_symbol) {
+  DCHECK(shard != NULL);
   DCHECK(public_symbol != NULL);
-  if (!MatchRulesBySymbolName(rules_by_type_[kPublicSymbolRule], public_symbol))
+  if (!shard->Owns(shard->public_symbols_seen++))
+    return true;
+
+  if (!MatchRulesBySymbolName(kPublicSymbolRule, shard, public_symbol))
     return false;
   return true;
 }
 
-bool FilterCompiler::MatchRulesBySymbolName(const RulePointers& rules,
+bool FilterCompiler::MatchRulesBySymbolName(RuleType rule_type,
+                                            CrawlShard* shard,
                                             IDiaSymbol* symbol) {
+  DCHECK_LE(0, rule_type);
+  DCHECK_GT(kRuleTypeCount, rule_type);
+  DCHECK(shard != NULL);
   DCHECK(symbol != NULL);
 
   // Get the symbol properties.
@@ -372,12 +545,19 @@ bool FilterCompiler::MatchRulesBySymbolName(const RulePointers& rules,
     return false;
   }
 
+  // Most symbols match none of the rules, and can be ruled out with a single
+  // scan of their name.
+  const RE* combined_regex = combined_regexes_[rule_type].get();
+  if (combined_regex != NULL && !combined_regex->FullMatch(name))
+    return true;
+
   // Look for any matching rules and update the associated image ranges.
-  RulePointers::const_iterator it = rules.begin();
-  for (; it != rules.end(); ++it) {
-    Rule* rule = *it;
-    if (rule->regex.FullMatch(name))
-      rule->ranges.Mark(Range(RelativeAddress(rva), length));
+  const RulePointers& rules = rules_by_type_[rule_type];
+  std::vector<RelativeAddressFilter>& ranges = shard->ranges[rule_type];
+  DCHECK_EQ(rules.size(), ranges.size());
+  for (size_t i = 0; i < rules.size(); ++i) {
+    if (rules[i]->regex.FullMatch(name))
+      ranges[i].Mark(Range(RelativeAddress(rva), length));
   }
 
   return true;
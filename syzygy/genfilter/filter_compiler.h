@@ -34,6 +34,11 @@
 //                  name.
 //
 // Comments may be specified using the '#' character.
+//
+// Compiling a filter crawls all of the function and public symbols of the
+// image. The rules of each type are also combined into a single regex, so that
+// the vast majority of symbols which match no rule are rejected with one scan
+// of their name.
 
 #ifndef SYZYGY_GENFILTER_FILTER_COMPILER_H_
 #define SYZYGY_GENFILTER_FILTER_COMPILER_H_
@@ -41,6 +46,7 @@
 #include <dia2.h>
 #include <map>
 
+#include "base/memory/scoped_ptr.h"
 #include "pcrecpp.h"  // NOLINT
 #include "syzygy/pe/image_filter.h"
 
@@ -71,14 +77,26 @@ class FilterCompiler {
   };
 
   // Constructor.
-  FilterCompiler() { }
+  FilterCompiler() : crawl_threads_(1) { }
 
   // @name Accessors.
   // @{
   const base::FilePath& image_path() const { return image_path_; }
   const base::FilePath& pdb_path() const { return pdb_path_; }
+  size_t crawl_threads() const { return crawl_threads_; }
   // @}
 
+  // Sets the number of worker threads used to crawl the symbols of the image.
+  // When this is greater than one the compilands and public symbols are
+  // sharded across the threads, each of which uses its own DIA session. The
+  // matches are merged once all threads are done, so the compiled filter is
+  // the same as a single-threaded one. Defaults to 1.
+  // @param crawl_threads the number of worker threads to use.
+  void set_crawl_threads(size_t crawl_threads) {
+    DCHECK_LT(0u, crawl_threads);
+    crawl_threads_ = crawl_threads;
+  }
+
   // Initializes this filter generator. Logs verbosely on failure.
   // @param image_path The path to the image for which a filter is being
   //     generated.
@@ -113,8 +131,9 @@ class FilterCompiler {
   bool Compile(ImageFilter* filter);
 
  protected:
-  // Forward declaration.
+  // Forward declarations.
   struct Rule;
+  struct CrawlShard;
 
   typedef pcrecpp::RE RE;
   typedef std::map<size_t, Rule> RuleMap;
@@ -139,22 +158,39 @@ class FilterCompiler {
   // @returns true on success, false otherwise.
   bool CrawlSymbols();
 
+  // Crawls the share of the symbols belonging to @p shard, in a DIA session of
+  // its own. The outcome is stored in the shard.
+  // @param shard The shard to crawl.
+  void CrawlShardSymbols(CrawlShard* shard);
+
+  // Same as CrawlShardSymbols, for use on a worker thread.
+  // @param shard The shard to crawl.
+  void CrawlShardSymbolsOnWorker(CrawlShard* shard);
+
+  // Combines the regexes of the rules of each type into combined_regexes_.
+  // Rules whose regex can't safely be embedded in a larger one prevent the
+  // combination for their type.
+  void BuildCombinedRegexes();
+
   // Fills in the filter using cached symbol match data in the rules.
   // @param filter The filter to be filled in.
   bool FillFilter(ImageFilter* filter);
 
-  // @name Symbol visitors.
+  // @name Symbol visitors. These skip the symbols belonging to other shards.
   // @{
-  bool OnCompiland(IDiaSymbol* compiland);
-  bool OnFunction(IDiaSymbol* function);
-  bool OnPublicSymbol(IDiaSymbol* public_symbol);
+  bool OnCompiland(CrawlShard* shard, IDiaSymbol* compiland);
+  bool OnFunction(CrawlShard* shard, IDiaSymbol* function);
+  bool OnPublicSymbol(CrawlShard* shard, IDiaSymbol* public_symbol);
   // @}
 
-  // Matches a symbol by name against rules in the given vector. Called by
-  // OnPublicSymbol and OnFunction.
-  // @param rules The vector of rules to be inspected for a symbol match.
+  // Matches a symbol by name against the rules of the given type, recording
+  // the matches in @p shard. Called by OnPublicSymbol and OnFunction.
+  // @param rule_type The type of the rules to be inspected for a symbol match.
+  // @param shard The shard in which to record matches.
   // @param symbol The symbol to inspect.
-  bool MatchRulesBySymbolName(const RulePointers& rules, IDiaSymbol* symbol);
+  bool MatchRulesBySymbolName(RuleType rule_type,
+                              CrawlShard* shard,
+                              IDiaSymbol* symbol);
 
   base::FilePath image_path_;
   base::FilePath pdb_path_;
@@ -168,6 +204,14 @@ class FilterCompiler {
   // symbols
   RulePointers rules_by_type_[kRuleTypeCount];
 
+  // The alternation of the regexes of the rules of each type. A symbol name
+  // that doesn't match this can't match any of the rules. This is NULL if the
+  // rules couldn't be combined, or if there's nothing to gain from it.
+  scoped_ptr<RE> combined_regexes_[kRuleTypeCount];
+
+  // The number of threads used to crawl symbols.
+  size_t crawl_threads_;
+
   DISALLOW_COPY_AND_ASSIGN(FilterCompiler);
 };
 
@@ -252,4 +252,51 @@ TEST_F(FilterCompilerTest, Compile) {
   EXPECT_LT(0u, filter.filter.size());
 }
 
+TEST_F(FilterCompilerTest, CompileMultiThreaded) {
+  ASSERT_NO_FATAL_FAILURE(CreateFilterDescriptionFile());
+
+  TestFilterCompiler fc1;
+  ASSERT_TRUE(fc1.Init(test_dll_, test_dll_pdb_));
+  ASSERT_TRUE(fc1.ParseFilterDescriptionFile(filter_txt_));
+  pe::ImageFilter filter1;
+  EXPECT_TRUE(fc1.Compile(&filter1));
+
+  TestFilterCompiler fc2;
+  ASSERT_TRUE(fc2.Init(test_dll_, test_dll_pdb_));
+  fc2.set_crawl_threads(3);
+  ASSERT_TRUE(fc2.ParseFilterDescriptionFile(filter_txt_));
+  pe::ImageFilter filter2;
+  EXPECT_TRUE(fc2.Compile(&filter2));
+
+  // Each rule should have matched the same ranges, no matter how the symbols
+  // were sharded.
+  for (size_t i = 0; i < fc1.rule_map_.size(); ++i)
+    EXPECT_EQ(fc1.rule(i).ranges, fc2.rule(i).ranges);
+  EXPECT_EQ(filter1.filter, filter2.filter);
+}
+
+TEST_F(FilterCompilerTest, CompileCombinedRules) {
+  // The function rules are matched through a combined regex. The public symbol
+  // rules can't be combined, as one of them uses a back reference.
+  TestFilterCompiler fc;
+  ASSERT_TRUE(fc.Init(test_dll_, test_dll_pdb_));
+  ASSERT_TRUE(fc.AddRule(FilterCompiler::kAddToFilter,
+                         FilterCompiler::kFunctionRule, "DllMain"));
+  ASSERT_TRUE(fc.AddRule(FilterCompiler::kAddToFilter,
+                         FilterCompiler::kFunctionRule, "ThisDoesNotExist"));
+  ASSERT_TRUE(fc.AddRule(FilterCompiler::kAddToFilter,
+                         FilterCompiler::kPublicSymbolRule,
+                         "(\\?)function1.*"));
+  ASSERT_TRUE(fc.AddRule(FilterCompiler::kAddToFilter,
+                         FilterCompiler::kPublicSymbolRule, "(x)\\1"));
+
+  pe::ImageFilter filter;
+  EXPECT_TRUE(fc.Compile(&filter));
+
+  EXPECT_EQ(1u, fc.rule(0).ranges.size());
+  EXPECT_EQ(0u, fc.rule(1).ranges.size());
+  EXPECT_EQ(1u, fc.rule(2).ranges.size());
+  EXPECT_EQ(0u, fc.rule(3).ranges.size());
+}
+
 }  // namespace genfilter
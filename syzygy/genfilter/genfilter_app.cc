@@ -15,8 +15,10 @@
 #include "syzygy/genfilter/genfilter_app.h"
 
 #include "base/file_util.h"
+#include "base/string_number_conversions.h"
 #include "base/string_util.h"
 #include "base/stringprintf.h"
+#include "base/sys_info.h"
 #include "syzygy/genfilter/filter_compiler.h"
 #include "syzygy/pe/image_filter.h"
 
@@ -65,7 +67,10 @@ const char kUsageFormatStr[] =
     "    The path of the module for which the filter is being generated.\n"
     "  --input-pdb=<path>                                          [OPTIONAL]\n"
     "    The path of the PDB corresponding to the input module. If not\n"
-    "    specified this will be searched for.\n";
+    "    specified this will be searched for.\n"
+    "  --crawl-threads=<count>                                     [OPTIONAL]\n"
+    "    The number of threads used to crawl the symbols of the module.\n"
+    "    Defaults to the number of processors.\n";
 
 // Applies the given action to a set of filters. Assumes that all of the filters
 // are already verified as belonging to the same module.
@@ -157,6 +162,18 @@ bool GenFilterApp::ParseCommandLine(const CommandLine* command_line) {
       return false;
     }
     input_pdb_ = command_line->GetSwitchValuePath("input-pdb");
+
+    crawl_threads_ = base::SysInfo::NumberOfProcessors();
+    if (command_line->HasSwitch("crawl-threads")) {
+      int crawl_threads = 0;
+      if (!base::StringToInt(command_line->GetSwitchValueASCII("crawl-threads"),
+                             &crawl_threads) ||
+          crawl_threads <= 0) {
+        PrintUsage(command_line, "Invalid value for '--crawl-threads'.");
+        return false;
+      }
+      crawl_threads_ = crawl_threads;
+    }
   } else if (LowerCaseEqualsASCII(action, "intersect")) {
     action_ = kIntersect;
     min_inputs = 2;
@@ -233,6 +250,7 @@ bool GenFilterApp::RunCompileAction() {
 
   if (!filter_compiler.Init(input_image_, input_pdb_))
     return false;
+  filter_compiler.set_crawl_threads(crawl_threads_);
 
   for (size_t i = 0; i < inputs_.size(); ++i) {
     LOG(INFO) << "Parsing filter description file \"" << inputs_[i].value()
@@ -28,6 +28,107 @@
 namespace grinder {
 namespace basic_block_util {
 
+namespace {
+
+// Orders basic-block IDs by the address of their range.
+struct BasicBlockIdAddressLess {
+  explicit BasicBlockIdAddressLess(const RelativeAddressRangeVector& bb_ranges)
+      : bb_ranges(bb_ranges) {
+  }
+
+  bool operator()(uint32 bb_id1, uint32 bb_id2) const {
+    return bb_ranges[bb_id1].start() < bb_ranges[bb_id2].start();
+  }
+
+  const RelativeAddressRangeVector& bb_ranges;
+};
+
+// Collects the visited ranges of the basic-blocks given by the address-sorted
+// @p addresses, @p sizes and @p bb_ids, reading the frequencies as an array of
+// @p FrequencyType. This is instantiated once per frequency size, so that the
+// loop doesn't dispatch on it for each basic-block.
+template <typename FrequencyType>
+void CollectVisitedRanges(const FrequencyType* frequencies,
+                          size_t num_columns,
+                          size_t column,
+                          const std::vector<uint32>& addresses,
+                          const std::vector<uint32>& sizes,
+                          const std::vector<uint32>& bb_ids,
+                          LineInfo::VisitedRanges* visited_ranges) {
+  DCHECK(frequencies != NULL);
+  DCHECK(visited_ranges != NULL);
+
+  for (size_t i = 0; i < bb_ids.size(); ++i) {
+    uint32 frequency = frequencies[bb_ids[i] * num_columns + column];
+    if (frequency == 0)
+      continue;
+    visited_ranges->push_back(LineInfo::VisitedRange(
+        RelativeAddress(addresses[i]), sizes[i], frequency));
+  }
+}
+
+}  // namespace
+
+void BasicBlockRangeIndex::Init(const RelativeAddressRangeVector& bb_ranges) {
+  bb_ids_.resize(bb_ranges.size());
+  for (size_t i = 0; i < bb_ranges.size(); ++i)
+    bb_ids_[i] = static_cast<uint32>(i);
+  std::stable_sort(bb_ids_.begin(), bb_ids_.end(),
+                   BasicBlockIdAddressLess(bb_ranges));
+
+  addresses_.resize(bb_ids_.size());
+  sizes_.resize(bb_ids_.size());
+  for (size_t i = 0; i < bb_ids_.size(); ++i) {
+    const RelativeAddressRange& bb_range = bb_ranges[bb_ids_[i]];
+    addresses_[i] = bb_range.start().value();
+    sizes_[i] = static_cast<uint32>(bb_range.size());
+  }
+}
+
+void BasicBlockRangeIndex::GetVisitedRanges(
+    const TraceIndexedFrequencyData* data,
+    size_t column,
+    LineInfo::VisitedRanges* visited_ranges) const {
+  DCHECK(data != NULL);
+  DCHECK(visited_ranges != NULL);
+  DCHECK(IsValidFrequencySize(data->frequency_size));
+  DCHECK_EQ(size(), data->num_entries);
+  DCHECK_LT(column, data->num_columns);
+
+  visited_ranges->clear();
+  visited_ranges->reserve(size());
+  switch (data->frequency_size) {
+    case 1:
+      CollectVisitedRanges(data->frequency_data, data->num_columns, column,
+                           addresses_, sizes_, bb_ids_, visited_ranges);
+      break;
+    case 2:
+      CollectVisitedRanges(
+          reinterpret_cast<const uint16*>(data->frequency_data),
+          data->num_columns, column, addresses_, sizes_, bb_ids_,
+          visited_ranges);
+      break;
+    case 4:
+      CollectVisitedRanges(
+          reinterpret_cast<const uint32*>(data->frequency_data),
+          data->num_columns, column, addresses_, sizes_, bb_ids_,
+          visited_ranges);
+      break;
+    default:
+      NOTREACHED();
+  }
+}
+
+bool BasicBlockRangeIndex::VisitLines(const TraceIndexedFrequencyData* data,
+                                      LineInfo* line_info) const {
+  DCHECK(data != NULL);
+  DCHECK(line_info != NULL);
+
+  LineInfo::VisitedRanges visited_ranges;
+  GetVisitedRanges(data, 0, &visited_ranges);
+  return line_info->VisitRanges(visited_ranges);
+}
+
 bool ModuleIdentityComparator::operator()(
     const ModuleInformation& lhs, const ModuleInformation& rhs) {
   if (lhs.module_size < rhs.module_size)
@@ -183,6 +284,7 @@ bool LoadPdbInfo(PdbInfoMap* pdb_info_cache,
   if (!LoadBasicBlockRanges(pdb_path, &pdb_info_ref.bb_ranges)) {
     return false;
   }
+  pdb_info_ref.bb_range_index.Init(pdb_info_ref.bb_ranges);
 
   // Populate the pdb_path field of pdb_info_ref, which marks the cached
   // entry as valid.
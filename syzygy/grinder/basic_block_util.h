@@ -76,6 +76,46 @@ typedef std::map<ModuleInformation,
                  IndexedFrequencyInformation,
                  ModuleIdentityComparator> ModuleIndexedFrequencyMap;
 
+// A flat index of the basic-block ranges of a module, sorted by address. It
+// maps the frequencies of an indexed frequency data record, which are in
+// basic-block ID order, to the visits of address-sorted ranges in a single
+// pass. The index is built once per module and reused for each of its
+// records.
+class BasicBlockRangeIndex {
+ public:
+  BasicBlockRangeIndex() { }
+
+  // Builds the index.
+  // @param bb_ranges the basic-block ranges, indexed by basic-block ID.
+  void Init(const RelativeAddressRangeVector& bb_ranges);
+
+  // @returns the number of basic-blocks in the index.
+  size_t size() const { return bb_ids_.size(); }
+
+  // Collects the ranges of the basic-blocks with a non-zero frequency.
+  // @param data the frequency data. It must have size() entries.
+  // @param column the column of the frequencies to use.
+  // @param visited_ranges receives the visited ranges, sorted by address.
+  void GetVisitedRanges(const TraceIndexedFrequencyData* data,
+                        size_t column,
+                        LineInfo::VisitedRanges* visited_ranges) const;
+
+  // Visits the source lines of the basic-blocks with a non-zero frequency,
+  // using the first column of frequencies.
+  // @param data the frequency data. It must have size() entries.
+  // @param line_info the line information to update.
+  // @returns true on success, false otherwise.
+  bool VisitLines(const TraceIndexedFrequencyData* data,
+                  LineInfo* line_info) const;
+
+ private:
+  // The addresses, sizes and IDs of the basic-blocks, sorted by address. These
+  // are kept in separate arrays so that a sweep reads them sequentially.
+  std::vector<uint32> addresses_;
+  std::vector<uint32> sizes_;
+  std::vector<uint32> bb_ids_;
+};
+
 // This structure holds the information extracted from a PDB file for a
 // given module.
 struct PdbInfo {
@@ -89,6 +129,10 @@ struct PdbInfo {
   // Basic-block addresses for the module associated with a particular PDB.
   // Used to transform basic-block frequency data to line visits via line_info.
   RelativeAddressRangeVector bb_ranges;
+
+  // The same ranges, sorted by address. This is shared by all the frequency
+  // data records of the module.
+  BasicBlockRangeIndex bb_range_index;
 };
 
 typedef std::map<ModuleInformation,
@@ -44,6 +44,8 @@ class TestGrinder : public GrinderInterface {
     ASSERT_TRUE(parser != NULL);
     parser_ = parser;
   }
+  virtual bool LoadData(const base::FilePath&) OVERRIDE { return true; }
+  virtual bool Merge(GrinderInterface*) OVERRIDE { return true; }
   virtual bool Grind() OVERRIDE { return true; }
   virtual bool OutputData(FILE*) OVERRIDE { return true; }
   // @}
@@ -295,5 +297,50 @@ TEST(GrinderBasicBlockUtilTest, GetFrequencyWithColumns) {
   EXPECT_EQ(0x77665544, GetFrequency(data, 0x0, 1));
 }
 
+TEST(GrinderBasicBlockUtilTest, BasicBlockRangeIndex) {
+  // The basic-block ranges, by basic-block ID. They aren't in address order.
+  RelativeAddressRangeVector bb_ranges;
+  bb_ranges.push_back(RelativeAddressRange(RelativeAddress(0x30), 0x8));
+  bb_ranges.push_back(RelativeAddressRange(RelativeAddress(0x10), 0x4));
+  bb_ranges.push_back(RelativeAddressRange(RelativeAddress(0x20), 0x10));
+  bb_ranges.push_back(RelativeAddressRange(RelativeAddress(0x14), 0xC));
+
+  BasicBlockRangeIndex index;
+  index.Init(bb_ranges);
+  EXPECT_EQ(bb_ranges.size(), index.size());
+
+  // Two columns of 2-byte frequencies, by basic-block ID.
+  static const uint16 kData[] = { 5, 0, 0, 1, 7, 2, 0, 3 };
+  uint8 buffer[sizeof(TraceIndexedFrequencyData) + sizeof(kData) - 1] = {};
+  TraceIndexedFrequencyData* data =
+      reinterpret_cast<TraceIndexedFrequencyData*>(buffer);
+  ::memcpy(data->frequency_data, kData, sizeof(kData));
+  data->num_columns = 2;
+  data->num_entries = bb_ranges.size();
+  data->data_type = common::IndexedFrequencyData::BRANCH;
+  data->frequency_size = 2;
+
+  // The basic-blocks with a zero frequency are left out, and the others come
+  // out in address order.
+  LineInfo::VisitedRanges visited_ranges;
+  index.GetVisitedRanges(data, 0, &visited_ranges);
+  ASSERT_EQ(2u, visited_ranges.size());
+  EXPECT_EQ(RelativeAddress(0x20), visited_ranges[0].address);
+  EXPECT_EQ(0x10u, visited_ranges[0].size);
+  EXPECT_EQ(7u, visited_ranges[0].count);
+  EXPECT_EQ(RelativeAddress(0x30), visited_ranges[1].address);
+  EXPECT_EQ(0x8u, visited_ranges[1].size);
+  EXPECT_EQ(5u, visited_ranges[1].count);
+
+  index.GetVisitedRanges(data, 1, &visited_ranges);
+  ASSERT_EQ(3u, visited_ranges.size());
+  EXPECT_EQ(RelativeAddress(0x10), visited_ranges[0].address);
+  EXPECT_EQ(1u, visited_ranges[0].count);
+  EXPECT_EQ(RelativeAddress(0x14), visited_ranges[1].address);
+  EXPECT_EQ(3u, visited_ranges[1].count);
+  EXPECT_EQ(RelativeAddress(0x20), visited_ranges[2].address);
+  EXPECT_EQ(2u, visited_ranges[2].count);
+}
+
 }  // namespace basic_block_util
 }  // namespace grinder
@@ -15,6 +15,8 @@
 #include "syzygy/grinder/cache_grind_writer.h"
 
 #include "base/file_util.h"
+#include "base/string_number_conversions.h"
+#include "base/string_split.h"
 #include "base/string_util.h"
 
 namespace grinder {
@@ -44,12 +46,13 @@ bool WriteCacheGrindCoverageFile(const CoverageData& coverage, FILE* file) {
   if (::fprintf(file, "events: Instrumented Executed\n") < 0)
     return false;
 
-  // Iterate over the source files.
-  CoverageData::SourceFileCoverageDataMap::const_iterator source_it =
-      coverage.source_file_coverage_data_map().begin();
-  CoverageData::SourceFileCoverageDataMap::const_iterator source_it_end =
-      coverage.source_file_coverage_data_map().end();
-  for (; source_it != source_it_end; ++source_it) {
+  // Iterate over the source files, in order of name.
+  CoverageData::SourceFileIdMap::const_iterator source_it =
+      coverage.source_file_ids().begin();
+  for (; source_it != coverage.source_file_ids().end(); ++source_it) {
+    const CoverageData::SourceFileCoverageData& source_file =
+        coverage.source_files()[source_it->second];
+
     // Output the path, being sure to use forward slashes instead of
     // back slashes.
     std::string path = source_it->first;
@@ -67,28 +70,88 @@ bool WriteCacheGrindCoverageFile(const CoverageData& coverage, FILE* file) {
     // keep track of the previous line. Lines are 1 indexed so we can use zero
     // as a special value.
     size_t prev_line = 0;
-    CoverageData::LineExecutionCountMap::const_iterator line_it =
-        source_it->second.line_execution_count_map.begin();
-    CoverageData::LineExecutionCountMap::const_iterator line_it_end =
-        source_it->second.line_execution_count_map.end();
-    for (; line_it != line_it_end; ++line_it) {
+    for (size_t line = 0; line < source_file.line_execution_counts.size();
+         ++line) {
+      if (!source_file.instrumented_lines[line])
+        continue;
+      uint32 count = source_file.line_execution_counts[line];
       if (prev_line == 0) {
         // Output the raw line number.
-        if (::fprintf(file, "%d 1 %d\n", line_it->first, line_it->second) < 0)
+        if (::fprintf(file, "%d 1 %d\n", line, count) < 0)
           return false;
       } else {
         // Output the line number as a delta from the previous line number.
-        DCHECK_LT(prev_line, line_it->first);
-        if (::fprintf(file, "+%d 1 %d\n", line_it->first - prev_line,
-                      line_it->second) < 0) {
+        DCHECK_LT(prev_line, line);
+        if (::fprintf(file, "+%d 1 %d\n", line - prev_line, count) < 0)
           return false;
-        }
       }
-      prev_line = line_it->first;
+      prev_line = line;
     }
   }
 
   return true;
 }
 
+bool ReadCacheGrindCoverageFile(const base::FilePath& path,
+                                CoverageData* coverage) {
+  DCHECK(coverage != NULL);
+
+  std::string contents;
+  if (!file_util::ReadFileToString(path, &contents)) {
+    LOG(ERROR) << "Failed to read CacheGrind file: " << path.value();
+    return false;
+  }
+
+  // This trims the whitespace surrounding each line.
+  std::vector<std::string> lines;
+  base::SplitString(contents, '\n', &lines);
+
+  std::string source_file_name;
+  size_t prev_line = 0;
+  for (size_t i = 0; i < lines.size(); ++i) {
+    const std::string& line = lines[i];
+
+    if (StartsWithASCII(line, "events:", true)) {
+      std::string events;
+      TrimWhitespaceASCII(line.substr(7), TRIM_ALL, &events);
+      if (events != "Instrumented Executed") {
+        LOG(ERROR) << "Not a CacheGrind coverage file: " << path.value();
+        return false;
+      }
+      continue;
+    }
+
+    if (StartsWithASCII(line, "fl=", true)) {
+      ::ReplaceChars(line.substr(3), "/", "\\", &source_file_name);
+      prev_line = 0;
+      continue;
+    }
+
+    // Skip the headers and the function names, only cost lines remain. These
+    // start with an absolute or a relative line number.
+    if (line.empty() || (!IsAsciiDigit(line[0]) && line[0] != '+'))
+      continue;
+
+    std::vector<std::string> fields;
+    base::SplitString(line, ' ', &fields);
+    size_t line_number = 0;
+    unsigned execution_count = 0;
+    if (source_file_name.empty() || fields.size() != 3 ||
+        !base::StringToSizeT(fields[0].substr(line[0] == '+' ? 1 : 0),
+                             &line_number) ||
+        !base::StringToUint(fields[2], &execution_count)) {
+      LOG(ERROR) << "Invalid cost line on line " << i + 1
+                 << " of CacheGrind file: " << path.value();
+      return false;
+    }
+    if (line[0] == '+')
+      line_number += prev_line;
+    prev_line = line_number;
+
+    coverage->AddLine(source_file_name, line_number, execution_count);
+  }
+
+  return true;
+}
+
 }  // namespace grinder
@@ -36,6 +36,16 @@ bool WriteCacheGrindCoverageFile(const CoverageData& coverage,
                                  const base::FilePath& path);
 bool WriteCacheGrindCoverageFile(const CoverageData& coverage, FILE* file);
 
+// Reads a CacheGrind file produced by WriteCacheGrindCoverageFile, adding the
+// line execution counts it contains to @p coverage. The forward slashes of the
+// source file paths are turned back into the back slashes of the paths of the
+// PDB files the coverage data was gathered from.
+// @param path the path to the file to be read.
+// @param coverage the coverage info to which the file contents are added.
+// @returns true on success, false otherwise.
+bool ReadCacheGrindCoverageFile(const base::FilePath& path,
+                                CoverageData* coverage);
+
 }  // namespace grinder
 
 #endif  // SYZYGY_GRINDER_CACHE_GRIND_WRITER_H_
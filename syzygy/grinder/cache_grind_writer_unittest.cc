@@ -26,17 +26,9 @@ namespace {
 class TestCoverageData : public CoverageData {
  public:
   void InitDummyData() {
-    CoverageData::SourceFileCoverageDataMap::iterator source_it =
-        source_file_coverage_data_map_.insert(
-            std::make_pair(std::string("C:\\src\\foo.cc"),
-                           CoverageData::SourceFileCoverageData())).first;
-
-    source_it->second.line_execution_count_map.insert(
-        std::make_pair(1, 1));
-    source_it->second.line_execution_count_map.insert(
-        std::make_pair(2, 1));
-    source_it->second.line_execution_count_map.insert(
-        std::make_pair(3, 0));
+    AddLine("C:\\src\\foo.cc", 1, 1);
+    AddLine("C:\\src\\foo.cc", 2, 1);
+    AddLine("C:\\src\\foo.cc", 3, 0);
   }
 };
 
@@ -64,4 +56,45 @@ TEST(CacheGrindWriterTest, Write) {
   EXPECT_EQ(expected_contents, actual_contents);
 }
 
+TEST(CacheGrindWriterTest, ReadWrittenFile) {
+  TestCoverageData coverage_data;
+  ASSERT_NO_FATAL_FAILURE(coverage_data.InitDummyData());
+
+  testing::ScopedTempFile temp;
+  ASSERT_TRUE(WriteCacheGrindCoverageFile(coverage_data, temp.path()));
+
+  // The counts are added to those already present, and the path is restored
+  // with back slashes.
+  CoverageData read_coverage_data;
+  read_coverage_data.AddLine("C:\\src\\foo.cc", 2, 1);
+  EXPECT_TRUE(ReadCacheGrindCoverageFile(temp.path(), &read_coverage_data));
+
+  CoverageData::SourceFileCoverageData expected_foo;
+  expected_foo.source_file_name = "C:\\src\\foo.cc";
+  expected_foo.AddLine(1, 1);
+  expected_foo.AddLine(2, 2);
+  expected_foo.AddLine(3, 0);
+  ASSERT_EQ(1U, read_coverage_data.source_files().size());
+  const CoverageData::SourceFileCoverageData* source_file =
+      read_coverage_data.FindSourceFile("C:\\src\\foo.cc");
+  ASSERT_TRUE(source_file != NULL);
+  EXPECT_TRUE(expected_foo == *source_file);
+}
+
+TEST(CacheGrindWriterTest, ReadFailsForOtherEvents) {
+  testing::ScopedTempFile temp;
+  std::string contents =
+      "positions: line\n"
+      "events: Inclusive Exclusive\n"
+      "fl=C:/src/foo.cc\n"
+      "fn=all\n"
+      "1 1 1\n";
+  ASSERT_EQ(static_cast<int>(contents.size()),
+            file_util::WriteFile(temp.path(), contents.c_str(),
+                                 contents.size()));
+
+  CoverageData coverage_data;
+  EXPECT_FALSE(ReadCacheGrindCoverageFile(temp.path(), &coverage_data));
+}
+
 }  // namespace grinder
@@ -11,47 +11,90 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
-
+//
 #include "syzygy/grinder/coverage_data.h"
 
+#include <algorithm>
+#include <limits>
+
 namespace grinder {
 
+void CoverageData::SourceFileCoverageData::AddLine(size_t line_number,
+                                                   uint32 execution_count) {
+  if (line_number >= line_execution_counts.size()) {
+    line_execution_counts.resize(line_number + 1, 0);
+    instrumented_lines.resize(line_number + 1, false);
+  }
+
+  if (!instrumented_lines[line_number]) {
+    instrumented_lines[line_number] = true;
+    ++num_instrumented_lines;
+  }
+
+  // Update the execution count using saturation arithmetic.
+  uint32& count = line_execution_counts[line_number];
+  count = std::min(count, std::numeric_limits<uint32>::max() -
+                              execution_count) + execution_count;
+}
+
 bool CoverageData::Add(const LineInfo& line_info) {
+  // The source lines point into the set of source file names of the line
+  // information, so source files are interned once and their IDs then looked
+  // up by pointer rather than by name.
+  typedef std::map<const std::string*, size_t> SourceFilePointerMap;
+  SourceFilePointerMap source_file_ids;
+
   // Multiple entries for the same source file are stored consecutively in
   // the LineInfo, hence we use this as a cache to prevent repeated lookups
-  // of source file names in our SourceFileCoverageDataMap.
+  // of source file IDs.
   const std::string* old_source_file_name = NULL;
-  SourceFileCoverageDataMap::iterator source_it;
+  SourceFileCoverageData* source_file = NULL;
 
   LineInfo::SourceLines::const_iterator line_it =
       line_info.source_lines().begin();
   for (; line_it != line_info.source_lines().end(); ++line_it) {
     DCHECK(line_it->source_file_name != NULL);
 
-    // Different source file? Then insert/lookup in our map.
+    // Different source file? Then lookup its ID, interning it if need be.
     if (old_source_file_name != line_it->source_file_name) {
-      // We don't care whether it already exists or not.
-      source_it = source_file_coverage_data_map_.insert(
-          std::make_pair(*line_it->source_file_name,
-                         SourceFileCoverageData())).first;
+      std::pair<SourceFilePointerMap::iterator, bool> result =
+          source_file_ids.insert(std::make_pair(line_it->source_file_name, 0));
+      if (result.second)
+        result.first->second = GetSourceFileId(*line_it->source_file_name);
+      source_file = &source_files_[result.first->second];
       old_source_file_name = line_it->source_file_name;
     }
 
-    // Insert/lookup the execution count by line number.
-    LineExecutionCountMap::iterator line_exec_it =
-        source_it->second.line_execution_count_map.insert(
-            std::make_pair(line_it->line_number, 0)).first;
-
-    // Update the execution count using saturation arithmetic.
-    if (line_it->visit_count > 0) {
-      line_exec_it->second =
-          std::min(line_exec_it->second,
-                   std::numeric_limits<size_t>::max() - line_it->visit_count) +
-          line_it->visit_count;
-    }
+    source_file->AddLine(line_it->line_number, line_it->visit_count);
   }
 
   return true;
 }
 
+void CoverageData::AddLine(const std::string& source_file_name,
+                           size_t line_number,
+                           uint32 execution_count) {
+  size_t id = GetSourceFileId(source_file_name);
+  source_files_[id].AddLine(line_number, execution_count);
+}
+
+const CoverageData::SourceFileCoverageData* CoverageData::FindSourceFile(
+    const std::string& source_file_name) const {
+  SourceFileIdMap::const_iterator it = source_file_ids_.find(source_file_name);
+  if (it == source_file_ids_.end())
+    return NULL;
+  return &source_files_[it->second];
+}
+
+size_t CoverageData::GetSourceFileId(const std::string& source_file_name) {
+  std::pair<SourceFileIdMap::iterator, bool> result =
+      source_file_ids_.insert(std::make_pair(source_file_name,
+                                             source_files_.size()));
+  if (result.second) {
+    source_files_.push_back(SourceFileCoverageData());
+    source_files_.back().source_file_name = source_file_name;
+  }
+  return result.first->second;
+}
+
 }  // namespace grinder
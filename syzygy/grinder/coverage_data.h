@@ -19,6 +19,7 @@
 #define SYZYGY_GRINDER_COVERAGE_DATA_H_
 
 #include <map>
+#include <vector>
 
 #include "base/files/file_path.h"
 #include "syzygy/grinder/line_info.h"
@@ -27,15 +28,19 @@ namespace grinder {
 
 // A simple class for accumulating data from LineInfo objects, representing
 // it with an alternative index.
+//
+// Source files are interned: each is given an ID, which indexes compact
+// per-file arrays of line execution counts. This keeps the memory used by
+// large coverage merges proportional to the number of source lines, and lets
+// the writers stream the source files out in order of name.
 class CoverageData {
  public:
   struct SourceFileCoverageData;  // Forward declaration.
 
-  // A map of line numbers to execution counts.
-  typedef std::map<size_t, uint32> LineExecutionCountMap;
-  // A map of file names to coverage information.
-  typedef std::map<std::string, SourceFileCoverageData>
-      SourceFileCoverageDataMap;
+  // A map of source file names to source file IDs.
+  typedef std::map<std::string, size_t> SourceFileIdMap;
+  // The coverage information of each source file, indexed by source file ID.
+  typedef std::vector<SourceFileCoverageData> SourceFileCoverageDataVector;
 
   // Adds the given line information to the internal representation.
   // @param line_info the LineInfo object whose coverage information is to be
@@ -43,19 +48,83 @@ class CoverageData {
   // @returns true on success, false otherwise.
   bool Add(const LineInfo& line_info);
 
-  const SourceFileCoverageDataMap& source_file_coverage_data_map() const {
-    return source_file_coverage_data_map_;
+  // Adds the execution count of a single line to the internal representation.
+  // This is used to restore previously output coverage data.
+  // @param source_file_name the name of the source file containing the line.
+  // @param line_number the line number.
+  // @param execution_count the number of times the line was executed. This is
+  //     added to any count already held for the line.
+  void AddLine(const std::string& source_file_name,
+               size_t line_number,
+               uint32 execution_count);
+
+  // Looks up the coverage information of a source file.
+  // @param source_file_name the name of the source file.
+  // @returns the coverage information of the source file, or NULL if there is
+  //     none.
+  const SourceFileCoverageData* FindSourceFile(
+      const std::string& source_file_name) const;
+
+  // @returns true if no coverage information has been added.
+  bool empty() const { return source_files_.empty(); }
+
+  // @name Accessors.
+  // @{
+  // Iterating the source file IDs visits the source files in order of name.
+  const SourceFileIdMap& source_file_ids() const { return source_file_ids_; }
+  const SourceFileCoverageDataVector& source_files() const {
+    return source_files_;
   }
+  // @}
 
  protected:
-  // Store coverage results, per source file.
-  SourceFileCoverageDataMap source_file_coverage_data_map_;
+  // Interns a source file name.
+  // @param source_file_name the name of the source file.
+  // @returns the ID of the source file.
+  size_t GetSourceFileId(const std::string& source_file_name);
+
+  // The IDs of the source files, by name.
+  SourceFileIdMap source_file_ids_;
+
+  // Store coverage results, per source file ID.
+  SourceFileCoverageDataVector source_files_;
 };
 
 // Coverage information that is stored per file. Right now this consists only
 // of line execution data, but branch and function data could be added.
 struct CoverageData::SourceFileCoverageData {
-  LineExecutionCountMap line_execution_count_map;
+  SourceFileCoverageData() : num_instrumented_lines(0) {
+  }
+
+  // Marks a line as instrumented and adds to its execution count, using
+  // saturation arithmetic.
+  // @param line_number the line number.
+  // @param execution_count the number of executions to add.
+  void AddLine(size_t line_number, uint32 execution_count);
+
+  // @returns true if @p other holds the same coverage information.
+  bool operator==(const SourceFileCoverageData& other) const {
+    return source_file_name == other.source_file_name &&
+        line_execution_counts == other.line_execution_counts &&
+        instrumented_lines == other.instrumented_lines;
+  }
+
+  // @param line_number the line number.
+  // @returns true if @p line_number is instrumented.
+  bool IsInstrumented(size_t line_number) const {
+    return line_number < instrumented_lines.size() &&
+        instrumented_lines[line_number];
+  }
+
+  // The name of the source file.
+  std::string source_file_name;
+  // The execution count of each line, indexed by line number. The count of a
+  // line that isn't instrumented is zero.
+  std::vector<uint32> line_execution_counts;
+  // Indicates whether each line is instrumented, indexed by line number.
+  std::vector<bool> instrumented_lines;
+  // The number of instrumented lines.
+  size_t num_instrumented_lines;
 };
 
 }  // namespace grinder
@@ -14,15 +14,12 @@
 
 #include "syzygy/grinder/coverage_data.h"
 
-#include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
 namespace grinder {
 
 namespace {
 
-using testing::ContainerEq;
-
 class TestLineInfo : public LineInfo {
  public:
   using LineInfo::source_files_;
@@ -47,16 +44,11 @@ class TestLineInfo : public LineInfo {
 
 }  // namespace
 
-// We provide this so that we can use ContainerEq. It must be outside of the
-// anonymous namespace for this to compile.
-bool operator==(const CoverageData::SourceFileCoverageData& lhs,
-                const CoverageData::SourceFileCoverageData& rhs) {
-  return lhs.line_execution_count_map == rhs.line_execution_count_map;
-}
-
 TEST(CoverageDataTest, Construct) {
   CoverageData coverage;
-  EXPECT_TRUE(coverage.source_file_coverage_data_map().empty());
+  EXPECT_TRUE(coverage.empty());
+  EXPECT_TRUE(coverage.source_file_ids().empty());
+  EXPECT_TRUE(coverage.source_files().empty());
 }
 
 TEST(CoverageDataTest, Add) {
@@ -65,16 +57,75 @@ TEST(CoverageDataTest, Add) {
 
   CoverageData coverage;
   EXPECT_TRUE(coverage.Add(line_info));
+  EXPECT_FALSE(coverage.empty());
+
+  CoverageData::SourceFileCoverageData expected_foo;
+  expected_foo.source_file_name = "foo.cc";
+  expected_foo.AddLine(1, 1);
+  expected_foo.AddLine(2, 1);
+  expected_foo.AddLine(3, 0);
+
+  ASSERT_EQ(1U, coverage.source_files().size());
+  const CoverageData::SourceFileCoverageData* foo =
+      coverage.FindSourceFile("foo.cc");
+  ASSERT_TRUE(foo != NULL);
+  EXPECT_TRUE(expected_foo == *foo);
+  EXPECT_EQ(3U, foo->num_instrumented_lines);
+  EXPECT_FALSE(foo->IsInstrumented(0));
+  EXPECT_TRUE(foo->IsInstrumented(3));
+  EXPECT_FALSE(foo->IsInstrumented(4));
+
+  // Adding the same line information again accumulates the execution counts
+  // in the same source file.
+  EXPECT_TRUE(coverage.Add(line_info));
+  expected_foo.AddLine(1, 1);
+  expected_foo.AddLine(2, 1);
+  ASSERT_EQ(1U, coverage.source_files().size());
+  EXPECT_TRUE(expected_foo == *coverage.FindSourceFile("foo.cc"));
+}
 
-  CoverageData::SourceFileCoverageDataMap expected_coverage_info_map;
-  CoverageData::LineExecutionCountMap& expected_line_exec =
-      expected_coverage_info_map["foo.cc"].line_execution_count_map;
-  expected_line_exec[1] = 1;
-  expected_line_exec[2] = 1;
-  expected_line_exec[3] = 0;
+TEST(CoverageDataTest, AddLine) {
+  TestLineInfo line_info;
+  ASSERT_NO_FATAL_FAILURE(line_info.InitDummyLineInfoFoo());
+
+  CoverageData coverage;
+  coverage.AddLine("foo.cc", 3, 2);
+  coverage.AddLine("foo.cc", 4, 0);
+  coverage.AddLine("bar.cc", 1, 0xFFFFFFFF);
+  coverage.AddLine("bar.cc", 1, 1);
+  EXPECT_TRUE(coverage.Add(line_info));
 
-  EXPECT_THAT(expected_coverage_info_map,
-              ContainerEq(coverage.source_file_coverage_data_map()));
+  CoverageData::SourceFileCoverageData expected_foo;
+  expected_foo.source_file_name = "foo.cc";
+  expected_foo.AddLine(1, 1);
+  expected_foo.AddLine(2, 1);
+  expected_foo.AddLine(3, 2);
+  expected_foo.AddLine(4, 0);
+  CoverageData::SourceFileCoverageData expected_bar;
+  expected_bar.source_file_name = "bar.cc";
+  expected_bar.AddLine(1, 0xFFFFFFFF);
+
+  const CoverageData::SourceFileCoverageData* foo =
+      coverage.FindSourceFile("foo.cc");
+  ASSERT_TRUE(foo != NULL);
+  EXPECT_TRUE(expected_foo == *foo);
+  const CoverageData::SourceFileCoverageData* bar =
+      coverage.FindSourceFile("bar.cc");
+  ASSERT_TRUE(bar != NULL);
+  EXPECT_TRUE(expected_bar == *bar);
+  EXPECT_EQ(0xFFFFFFFF, bar->line_execution_counts[1]);
+  EXPECT_TRUE(coverage.FindSourceFile("baz.cc") == NULL);
+
+  // The source files are interned in order of appearance, and iterated in
+  // order of name.
+  ASSERT_EQ(2U, coverage.source_file_ids().size());
+  CoverageData::SourceFileIdMap::const_iterator id_it =
+      coverage.source_file_ids().begin();
+  EXPECT_EQ("bar.cc", id_it->first);
+  EXPECT_EQ(1U, id_it->second);
+  ++id_it;
+  EXPECT_EQ("foo.cc", id_it->first);
+  EXPECT_EQ(0U, id_it->second);
 }
 
 }  // namespace grinder
@@ -40,6 +40,8 @@
         'lcov_writer.h',
         'line_info.cc',
         'line_info.h',
+        'symbolizer.cc',
+        'symbolizer.h',
         'grinders/coverage_grinder.cc',
         'grinders/coverage_grinder.h',
         'grinders/indexed_frequency_data_grinder.cc',
@@ -53,6 +55,8 @@
         '<(src)/sawbuck/common/common.gyp:common',
         '<(src)/sawbuck/log_lib/log_lib.gyp:log_lib',
         '<(src)/syzygy/common/common.gyp:common_lib',
+        '<(src)/syzygy/common/common.gyp:stage_profiler_lib',
+        '<(src)/syzygy/pdb/pdb.gyp:pdb_lib',
         '<(src)/syzygy/pe/pe.gyp:dia_sdk',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
         '<(src)/syzygy/trace/parse/parse.gyp:parse_lib',
@@ -72,6 +76,7 @@
         'indexed_frequency_data_serializer_unittest.cc',
         'lcov_writer_unittest.cc',
         'line_info_unittest.cc',
+        'symbolizer_unittest.cc',
         'grinders/coverage_grinder_unittest.cc',
         'grinders/profile_grinder_unittest.cc',
         'grinders/sample_grinder_unittest.cc',
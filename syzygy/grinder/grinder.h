@@ -19,6 +19,7 @@
 #define SYZYGY_GRINDER_GRINDER_H_
 
 #include "base/command_line.h"
+#include "base/files/file_path.h"
 #include "syzygy/trace/parse/parser.h"
 
 namespace grinder {
@@ -43,6 +44,30 @@ class GrinderInterface : public trace::parser::ParseEventHandlerImpl {
   //     handler.
   virtual void SetParser(Parser* parser) = 0;
 
+  // Loads the output of a previous run of this grinder as its initial state,
+  // so that the trace files parsed next are merged into it. This allows new
+  // trace files to be ground incrementally rather than reprocessing all of
+  // the trace files that contributed to the previous output. This will be
+  // called after a successful call to ParseCommandLine and prior to any parse
+  // event handling.
+  // @param path the path to the output of a previous run, which must have been
+  //     produced by a grinder of the same type and configuration.
+  // @returns true on success, false otherwise.
+  // @note The implementation should log on failure.
+  virtual bool LoadData(const base::FilePath& path) = 0;
+
+  // Merges the parse results accumulated by another grinder into this one.
+  // This is used when trace files are parsed in parallel: each trace file is
+  // fed to a grinder of its own, and the grinders are then merged together.
+  // This will only be called on grinders of the same type that were
+  // configured with the same command-line, after all parse events have been
+  // handled by both and prior to any call to Grind.
+  // @param other the grinder to be merged. Its state may be consumed in the
+  //     process.
+  // @returns true on success, false otherwise.
+  // @note The implementation should log on failure.
+  virtual bool Merge(GrinderInterface* other) = 0;
+
   // Performs any computation/aggregation/summarization that needs to be done
   // after having parsed trace files. This will only be called after a
   // successful call to ParseCommandLine and after all parse events have been
@@ -16,8 +16,10 @@
 
 #include "base/file_util.h"
 #include "base/logging.h"
+#include "base/string_number_conversions.h"
 #include "base/string_util.h"
 #include "base/stringprintf.h"
+#include "syzygy/common/stage_profiler.h"
 #include "syzygy/grinder/grinders/coverage_grinder.h"
 #include "syzygy/grinder/grinders/indexed_frequency_data_grinder.h"
 #include "syzygy/grinder/grinders/profile_grinder.h"
@@ -50,6 +52,35 @@ const char kUsageFormatStr[] =
     "Optional parameters\n"
     "  --output-file=<output file>\n"
     "    The location of output file. If not specified, output is to stdout.\n"
+    "  --merge-with=<previous output file>\n"
+    "    The output of a previous run into which the trace files are merged,\n"
+    "    so that only new trace files need to be processed. This must have\n"
+    "    been produced in the same mode and format. It may be the same file\n"
+    "    as the output file. Supported in 'bbentry', 'branch' and 'coverage'\n"
+    "    modes.\n"
+    "  --parse-threads=<count>\n"
+    "    The number of trace files to parse concurrently. This requires each\n"
+    "    trace file to contain all of the events of the processes it covers.\n"
+    "    Defaults to 1.\n"
+    "  --profile-output=<path>\n"
+    "    Write the time spent in, and the memory used by, each stage of the\n"
+    "    grinder to this JSON file.\n"
+    "bbentry and branch mode optional parameters\n"
+    "  --output-format=<output format>\n"
+    "    Output format must be one of 'json', 'binary' or 'hot-sites'. The\n"
+    "    binary format is faster to save and load for large images. The\n"
+    "    hot-sites format lists the hottest sites of each function in CSV\n"
+    "    format, the functions by decreasing total count. For a module\n"
+    "    instrumented in asan mode with --count-checks, the sites are the\n"
+    "    memory access checks. Defaults to 'json' if not explicitly\n"
+    "    specified.\n"
+    "  --hot-sites-per-function=<count>\n"
+    "    The number of sites listed for each function in hot-sites format.\n"
+    "    Defaults to 10.\n"
+    "  --pretty-print\n"
+    "    Pretty-print the JSON output.\n"
+    "  --symbol-cache-dir=<directory>\n"
+    "    As in profile mode, for the hot-sites format.\n"
     "coverage mode optional parameters\n"
     "  --output-format=<output format>\n"
     "    Output format must be one of 'lcov' or 'cachegrind'. Defaults to\n"
@@ -58,12 +89,21 @@ const char kUsageFormatStr[] =
     "  --thread-parts\n"
     "    Aggregate and output separate parts for each thread seen in the\n"
     "    trace files.\n"
+    "  --symbol-cache-dir=<directory>\n"
+    "    The directory of a persistent cache of resolved symbols, keyed on\n"
+    "    the GUID and age of the PDB files. Grinding traces of a build that\n"
+    "    is in the cache needs no symbol lookups. Defaults to the value of\n"
+    "    the SYZYGY_SYMBOL_CACHE_DIR environment variable, if set.\n"
     "sample mode optional parameters\n"
     "  --aggregation-level=<level>\n"
     "    The level of aggregation. Must be one of 'basic-block', 'function',\n"
-    "    'compiland' or 'line'. Output is in CSV format, except for 'line'\n"
-    "    aggregation, which outputs to KCacheGrind format. Defaults to\n"
-    "    'basic-block'.\n"
+    "    'compiland', 'line' or 'stack'. Output is in CSV format, except for\n"
+    "    'line' aggregation, which outputs to KCacheGrind format, and 'stack'\n"
+    "    aggregation, which outputs the sampled call stacks in the folded\n"
+    "    format of flame graph tools. Defaults to 'basic-block'.\n"
+    "  --grind-threads=<count>\n"
+    "    The number of modules to decompose and grind concurrently in the\n"
+    "    'function' and 'compiland' aggregation modes. Defaults to 1.\n"
     "  --image=<path>\n"
     "    The path to the image for which sampling information is to be\n"
     "    processed. If this is not specified then aggregate information\n"
@@ -72,9 +112,13 @@ const char kUsageFormatStr[] =
     "    only one module may be processed at a time in this mode.\n"
     "\n";
 
+// The maximum number of trace files to parse concurrently.
+const size_t kMaxParseThreads = 64;
+
 }  // namespace
 
-GrinderApp::GrinderApp() : common::AppImplBase("Grinder"), mode_(kProfile) {
+GrinderApp::GrinderApp()
+    : common::AppImplBase("Grinder"), mode_(kProfile), parse_threads_(1) {
 }
 
 void GrinderApp::PrintUsage(const base::FilePath& program,
@@ -115,24 +159,20 @@ bool GrinderApp::ParseCommandLine(const CommandLine* command_line) {
   std::string mode = command_line->GetSwitchValueASCII("mode");
   if (LowerCaseEqualsASCII(mode, "profile")) {
     mode_ = kProfile;
-    grinder_.reset(new grinders::ProfileGrinder());
   } else if (LowerCaseEqualsASCII(mode, "coverage")) {
     mode_ = kCoverage;
-    grinder_.reset(new grinders::CoverageGrinder());
   } else if (LowerCaseEqualsASCII(mode, "bbentry")) {
     mode_ = kBasicBlockEntry;
-    grinder_.reset(new grinders::IndexedFrequencyDataGrinder());
   } else if (LowerCaseEqualsASCII(mode, "branch")) {
     mode_ = kIndexedFrequencyData;
-    grinder_.reset(new grinders::IndexedFrequencyDataGrinder());
   } else if (LowerCaseEqualsASCII(mode, "sample")) {
     mode_ = kSample;
-    grinder_.reset(new grinders::SampleGrinder());
   } else {
     PrintUsage(command_line->GetProgram(),
                base::StringPrintf("Unknown mode: %s.", mode.c_str()));
     return false;
   }
+  grinder_.reset(CreateGrinder(mode_));
   DCHECK(grinder_.get() != NULL);
 
   // Parse the command-line for the grinder.
@@ -144,6 +184,25 @@ bool GrinderApp::ParseCommandLine(const CommandLine* command_line) {
   }
 
   output_file_ = command_line->GetSwitchValuePath("output-file");
+  merge_with_ = command_line->GetSwitchValuePath("merge-with");
+  profile_output_path_ = command_line->GetSwitchValuePath("profile-output");
+
+  std::string parse_threads = command_line->GetSwitchValueASCII(
+      "parse-threads");
+  if (!parse_threads.empty()) {
+    if (!base::StringToSizeT(parse_threads, &parse_threads_) ||
+        parse_threads_ < 1 || parse_threads_ > kMaxParseThreads) {
+      PrintUsage(command_line->GetProgram(),
+                 base::StringPrintf("The number of parse threads must be "
+                                    "between 1 and %d.",
+                                    static_cast<int>(kMaxParseThreads)));
+      return false;
+    }
+  }
+
+  // Keep the command-line around to configure the grinder of each trace file
+  // when parsing them in parallel.
+  command_line_.reset(new CommandLine(*command_line));
 
   return true;
 }
@@ -151,16 +210,35 @@ bool GrinderApp::ParseCommandLine(const CommandLine* command_line) {
 int GrinderApp::Run() {
   DCHECK(grinder_.get() != NULL);
 
+  // When parsing in parallel each trace file is consumed by a grinder of its
+  // own, and grinder_ only serves to merge their results.
   trace::parser::Parser parser;
-  grinder_->SetParser(&parser);
-  if (!parser.Init(grinder_.get()))
-    return 1;
+  trace::parser::ParallelParser parallel_parser(parse_threads_);
+  if (parse_threads_ > 1) {
+    for (size_t i = 0; i < trace_files_.size(); ++i)
+      parallel_parser.OpenTraceFile(trace_files_[i]);
+  } else {
+    grinder_->SetParser(&parser);
+    if (!parser.Init(grinder_.get()))
+      return 1;
+
+    // Open the input files.
+    for (size_t i = 0; i < trace_files_.size(); ++i) {
+      if (!parser.OpenTraceFile(trace_files_[i])) {
+        LOG(ERROR) << "Unable to open trace file \'"
+                   << trace_files_[i].value() << "'";
+        return 1;
+      }
+    }
+  }
 
-  // Open the input files.
-  for (size_t i = 0; i < trace_files_.size(); ++i) {
-    if (!parser.OpenTraceFile(trace_files_[i])) {
-      LOG(ERROR) << "Unable to open trace file \'"
-                 << trace_files_[i].value() << "'";
+  // Load the previous output before opening the output file, as they may be
+  // one and the same.
+  if (!merge_with_.empty()) {
+    LOG(INFO) << "Loading previous output \"" << merge_with_.value() << "\".";
+    if (!grinder_->LoadData(merge_with_)) {
+      LOG(ERROR) << "Unable to load previous output \'"
+                 << merge_with_.value() << "'";
       return 1;
     }
   }
@@ -181,15 +259,20 @@ int GrinderApp::Run() {
   }
 
   LOG(INFO) << "Parsing trace files.";
-  if (!parser.Consume()) {
+  bool parsed = parse_threads_ > 1 ? parallel_parser.Consume(this) :
+                                     parser.Consume();
+  if (!parsed) {
     LOG(ERROR) << "Error parsing trace files.";
     return 1;
   }
 
   LOG(INFO) << "Aggregating data.";
-  if (!grinder_->Grind()) {
-    LOG(ERROR) << "Failed to grind data.";
-    return 1;
+  {
+    common::ScopedStageTimer timer("GrinderInterface::Grind");
+    if (!grinder_->Grind()) {
+      LOG(ERROR) << "Failed to grind data.";
+      return 1;
+    }
   }
 
   std::wstring output_name(L"stdout");
@@ -197,14 +280,65 @@ int GrinderApp::Run() {
     output_name = base::StringPrintf(L"\"%ls\"", output_file_.value().c_str());
   LOG(INFO) << "Writing output to " << output_name << ".";
   DCHECK(output != NULL);
-  if (!grinder_->OutputData(output)) {
-    LOG(ERROR) << "Failed to output data.";
+  {
+    common::ScopedStageTimer timer("GrinderInterface::OutputData");
+    if (!grinder_->OutputData(output)) {
+      LOG(ERROR) << "Failed to output data.";
+      return 1;
+    }
+  }
+
+  if (!profile_output_path_.empty() &&
+      !common::StageProfiler::Instance()->SaveToFile(profile_output_path_)) {
     return 1;
   }
 
   return 0;
 }
 
+trace::parser::ParseEventHandler* GrinderApp::CreateEventHandler(
+    trace::parser::Parser* parser) {
+  DCHECK(parser != NULL);
+  DCHECK(command_line_.get() != NULL);
+
+  scoped_ptr<GrinderInterface> grinder(CreateGrinder(mode_));
+  if (!grinder->ParseCommandLine(command_line_.get()))
+    return NULL;
+  grinder->SetParser(parser);
+
+  return grinder.release();
+}
+
+bool GrinderApp::MergeEventHandler(trace::parser::ParseEventHandler* handler) {
+  DCHECK(handler != NULL);
+  DCHECK(grinder_.get() != NULL);
+
+  return grinder_->Merge(static_cast<GrinderInterface*>(handler));
+}
+
+void GrinderApp::DestroyEventHandler(
+    trace::parser::ParseEventHandler* handler) {
+  DCHECK(handler != NULL);
+  delete static_cast<GrinderInterface*>(handler);
+}
+
+GrinderInterface* GrinderApp::CreateGrinder(Mode mode) {
+  switch (mode) {
+    case kProfile:
+      return new grinders::ProfileGrinder();
+    case kCoverage:
+      return new grinders::CoverageGrinder();
+    case kBasicBlockEntry:
+    case kIndexedFrequencyData:
+      return new grinders::IndexedFrequencyDataGrinder();
+    case kSample:
+      return new grinders::SampleGrinder();
+  }
+
+  NOTREACHED() << "Unknown mode: " << mode << ".";
+  return NULL;
+}
+
 void GrinderApp::TearDown() {
   // Release the grinder so it has a chance to clean up before COM goes away.
   grinder_.reset();
@@ -14,15 +14,19 @@
 #ifndef SYZYGY_GRINDER_GRINDER_APP_H_
 #define SYZYGY_GRINDER_GRINDER_APP_H_
 
+#include "base/command_line.h"
 #include "base/files/file_path.h"
+#include "base/memory/scoped_ptr.h"
 #include "syzygy/common/application.h"
 #include "syzygy/grinder/grinder.h"
+#include "syzygy/trace/parse/parallel_parser.h"
 
 namespace grinder {
 
 // The application class that takes care of running Grinder over a set of
 // profiler trace files.
-class GrinderApp : public common::AppImplBase {
+class GrinderApp : public common::AppImplBase,
+                   public trace::parser::ParallelParser::Delegate {
  public:
   GrinderApp();
 
@@ -48,11 +52,44 @@ class GrinderApp : public common::AppImplBase {
                   const base::StringPiece& message);
   // @}
 
+  // @name trace::parser::ParallelParser::Delegate implementation.
+  // These create, merge and destroy the grinders that consume each trace file
+  // when they are parsed in parallel.
+  // @{
+  virtual trace::parser::ParseEventHandler* CreateEventHandler(
+      trace::parser::Parser* parser) OVERRIDE;
+  virtual bool MergeEventHandler(
+      trace::parser::ParseEventHandler* handler) OVERRIDE;
+  virtual void DestroyEventHandler(
+      trace::parser::ParseEventHandler* handler) OVERRIDE;
+  // @}
+
  protected:
+  // Creates a grinder for the given processing mode.
+  // @param mode the processing mode.
+  // @returns a new, unconfigured grinder.
+  static GrinderInterface* CreateGrinder(Mode mode);
+
   std::vector<base::FilePath> trace_files_;
   base::FilePath output_file_;
+
+  // The output of a previous run into which the trace files are merged, if
+  // any.
+  base::FilePath merge_with_;
+
+  // The path of the stage profile to write, if any.
+  base::FilePath profile_output_path_;
+
   Mode mode_;
   scoped_ptr<GrinderInterface> grinder_;
+
+  // The number of trace files to parse concurrently. If this is greater than
+  // one each trace file is fed to a grinder of its own, and these are merged
+  // into grinder_.
+  size_t parse_threads_;
+
+  // The command-line used to configure the grinders.
+  scoped_ptr<CommandLine> command_line_;
 };
 
 }  // namespace grinder
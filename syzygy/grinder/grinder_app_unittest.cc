@@ -18,6 +18,7 @@
 #include "gtest/gtest.h"
 #include "syzygy/common/application.h"
 #include "syzygy/core/unittest_util.h"
+#include "syzygy/grinder/lcov_writer.h"
 #include "syzygy/pe/unittest_util.h"
 #include "syzygy/sampler/unittest_util.h"
 
@@ -30,6 +31,9 @@ class TestGrinderApp : public GrinderApp {
   // Expose for testing.
   using GrinderApp::trace_files_;
   using GrinderApp::output_file_;
+  using GrinderApp::merge_with_;
+  using GrinderApp::profile_output_path_;
+  using GrinderApp::parse_threads_;
 };
 
 class GrinderAppTest : public testing::PELibUnitTest {
@@ -118,6 +122,51 @@ TEST_F(GrinderAppTest, ParseCommandLineOutputFile) {
   ASSERT_EQ(L"output.txt", impl_.output_file_.value());
 }
 
+TEST_F(GrinderAppTest, ParseCommandLineMergeWith) {
+  ASSERT_TRUE(impl_.merge_with_.empty());
+  cmd_line_.AppendSwitchASCII("mode", "coverage");
+  cmd_line_.AppendSwitchPath("merge-with", base::FilePath(L"previous.lcov"));
+  cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
+      testing::kCoverageTraceFiles[0]));
+
+  ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
+  ASSERT_EQ(L"previous.lcov", impl_.merge_with_.value());
+}
+
+TEST_F(GrinderAppTest, ParseCommandLineProfileOutput) {
+  ASSERT_TRUE(impl_.profile_output_path_.empty());
+  cmd_line_.AppendSwitchASCII("mode", "profile");
+  cmd_line_.AppendSwitchPath("profile-output",
+                             base::FilePath(L"profile.json"));
+  cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
+      testing::kProfileTraceFiles[0]));
+
+  ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
+  ASSERT_EQ(L"profile.json", impl_.profile_output_path_.value());
+}
+
+TEST_F(GrinderAppTest, ParseCommandLineParseThreads) {
+  cmd_line_.AppendSwitchASCII("mode", "profile");
+  cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
+      testing::kProfileTraceFiles[0]));
+
+  ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(1u, impl_.parse_threads_);
+
+  cmd_line_.AppendSwitchASCII("parse-threads", "4");
+  ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(4u, impl_.parse_threads_);
+}
+
+TEST_F(GrinderAppTest, ParseCommandLineFailsWithInvalidParseThreads) {
+  cmd_line_.AppendSwitchASCII("mode", "profile");
+  cmd_line_.AppendSwitchASCII("parse-threads", "0");
+  cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
+      testing::kProfileTraceFiles[0]));
+
+  ASSERT_FALSE(impl_.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(GrinderAppTest, BasicBlockEntryEndToEnd) {
   cmd_line_.AppendSwitchASCII("mode", "bbentry");
   cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
@@ -154,6 +203,27 @@ TEST_F(GrinderAppTest, ProfileEndToEnd) {
   EXPECT_TRUE(file_util::PathExists(output_file));
 }
 
+TEST_F(GrinderAppTest, ParallelProfileEndToEnd) {
+  cmd_line_.AppendSwitchASCII("mode", "profile");
+  cmd_line_.AppendSwitchASCII("parse-threads", "2");
+  for (size_t i = 0; i < arraysize(testing::kProfileTraceFiles); ++i) {
+    cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
+        testing::kProfileTraceFiles[i]));
+  }
+
+  base::FilePath output_file;
+  ASSERT_TRUE(file_util::CreateTemporaryFileInDir(temp_dir_, &output_file));
+  ASSERT_TRUE(file_util::Delete(output_file, false));
+  cmd_line_.AppendSwitchPath("output-file", output_file);
+
+  ASSERT_TRUE(!file_util::PathExists(output_file));
+
+  EXPECT_EQ(0, app_.Run());
+
+  // Verify that the output file was created.
+  EXPECT_TRUE(file_util::PathExists(output_file));
+}
+
 TEST_F(GrinderAppTest, CoverageEndToEnd) {
   cmd_line_.AppendSwitchASCII("mode", "coverage");
   cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
@@ -173,6 +243,69 @@ TEST_F(GrinderAppTest, CoverageEndToEnd) {
   EXPECT_TRUE(file_util::PathExists(output_file));
 }
 
+TEST_F(GrinderAppTest, IncrementalCoverageEndToEnd) {
+  cmd_line_.AppendSwitchASCII("mode", "coverage");
+  cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
+      testing::kCoverageTraceFiles[0]));
+  cmd_line_.AppendSwitchASCII("output-format", "lcov");
+
+  // Produce the output the next run is merged into.
+  base::FilePath previous_file = temp_dir_.Append(L"previous.lcov");
+  CommandLine previous_cmd_line(cmd_line_);
+  previous_cmd_line.AppendSwitchPath("output-file", previous_file);
+  app_.set_command_line(&previous_cmd_line);
+  ASSERT_EQ(0, app_.Run());
+
+  // Grind the same trace file again, merging it into the previous output.
+  base::FilePath output_file = temp_dir_.Append(L"merged.lcov");
+  cmd_line_.AppendSwitchPath("merge-with", previous_file);
+  cmd_line_.AppendSwitchPath("output-file", output_file);
+  TestApplication app;
+  app.set_command_line(&cmd_line_);
+  app.set_in(in());
+  app.set_out(out());
+  app.set_err(err());
+  EXPECT_EQ(0, app.Run());
+
+  // The merged output must hold twice the execution counts of the previous
+  // one.
+  CoverageData previous_coverage;
+  ASSERT_TRUE(ReadLcovCoverageFile(previous_file, &previous_coverage));
+  CoverageData merged_coverage;
+  ASSERT_TRUE(ReadLcovCoverageFile(output_file, &merged_coverage));
+  ASSERT_FALSE(previous_coverage.empty());
+  ASSERT_EQ(previous_coverage.source_files().size(),
+            merged_coverage.source_files().size());
+  CoverageData::SourceFileIdMap::const_iterator previous_it =
+      previous_coverage.source_file_ids().begin();
+  for (; previous_it != previous_coverage.source_file_ids().end();
+       ++previous_it) {
+    const CoverageData::SourceFileCoverageData& previous_file =
+        previous_coverage.source_files()[previous_it->second];
+    const CoverageData::SourceFileCoverageData* merged_file =
+        merged_coverage.FindSourceFile(previous_it->first);
+    ASSERT_TRUE(merged_file != NULL);
+    ASSERT_EQ(previous_file.instrumented_lines,
+              merged_file->instrumented_lines);
+    for (size_t i = 0; i < previous_file.line_execution_counts.size(); ++i) {
+      EXPECT_EQ(2 * previous_file.line_execution_counts[i],
+                merged_file->line_execution_counts[i]);
+    }
+  }
+}
+
+TEST_F(GrinderAppTest, IncrementalProfileFails) {
+  cmd_line_.AppendSwitchASCII("mode", "profile");
+  cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
+      testing::kProfileTraceFiles[0]));
+
+  base::FilePath previous_file;
+  ASSERT_TRUE(file_util::CreateTemporaryFileInDir(temp_dir_, &previous_file));
+  cmd_line_.AppendSwitchPath("merge-with", previous_file);
+
+  EXPECT_NE(0, app_.Run());
+}
+
 TEST_F(GrinderAppTest, SampleEndToEnd) {
   base::FilePath trace_file = temp_dir_.Append(L"sampler.bin");
   ASSERT_NO_FATAL_FAILURE(testing::WriteDummySamplerTraceFile(trace_file));
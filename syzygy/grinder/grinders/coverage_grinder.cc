@@ -29,8 +29,6 @@ namespace grinders {
 namespace {
 
 using basic_block_util::ModuleInformation;
-using basic_block_util::RelativeAddressRange;
-using basic_block_util::GetFrequency;
 using basic_block_util::LoadPdbInfo;
 using basic_block_util::IsValidFrequencySize;
 using basic_block_util::PdbInfo;
@@ -73,13 +71,54 @@ void CoverageGrinder::SetParser(Parser* parser) {
   parser_ = parser;
 }
 
+bool CoverageGrinder::LoadData(const base::FilePath& path) {
+  // The previous output is held in the coverage data, to which Merge and
+  // Grind add the line information of the new trace files. These functions
+  // log verbosely for us.
+  switch (output_format_) {
+    case kLcovFormat:
+      return ReadLcovCoverageFile(path, &coverage_data_);
+
+    case kCacheGrindFormat:
+      return ReadCacheGrindCoverageFile(path, &coverage_data_);
+
+    default: NOTREACHED() << "Unknown OutputFormat.";
+  }
+
+  return false;
+}
+
+bool CoverageGrinder::Merge(GrinderInterface* other) {
+  DCHECK(other != NULL);
+  CoverageGrinder* other_grinder = static_cast<CoverageGrinder*>(other);
+  DCHECK_EQ(output_format_, other_grinder->output_format_);
+
+  if (other_grinder->event_handler_errored_)
+    event_handler_errored_ = true;
+
+  // The line information of the other grinder is aggregated straight into the
+  // coverage data, as this is keyed by source file and line number and is
+  // therefore independent of the PDB info cache it came from. Grind adds our
+  // own line information to it later on.
+  PdbInfoMap::const_iterator it = other_grinder->pdb_info_cache_.begin();
+  for (; it != other_grinder->pdb_info_cache_.end(); ++it) {
+    if (!coverage_data_.Add(it->second.line_info)) {
+      LOG(ERROR) << "Failed to merge line information from PDB: "
+                 << it->first.image_file_name;
+      return false;
+    }
+  }
+
+  return true;
+}
+
 bool CoverageGrinder::Grind() {
   if (event_handler_errored_) {
     LOG(WARNING) << "Failed to handle all basic block frequency data events, "
                  << "coverage results will be partial.";
   }
 
-  if (pdb_info_cache_.empty()) {
+  if (pdb_info_cache_.empty() && coverage_data_.empty()) {
     LOG(ERROR) << "No coverage data was encountered.";
     return false;
   }
@@ -92,14 +131,14 @@ bool CoverageGrinder::Grind() {
       return false;
     }
   }
-  DCHECK(!coverage_data_.source_file_coverage_data_map().empty());
+  DCHECK(!coverage_data_.empty());
 
   return true;
 }
 
 bool CoverageGrinder::OutputData(FILE* file) {
   DCHECK(file != NULL);
-  DCHECK(!coverage_data_.source_file_coverage_data_map().empty());
+  DCHECK(!coverage_data_.empty());
 
   // These functions log verbosely for us.
   switch (output_format_) {
@@ -177,23 +216,13 @@ void CoverageGrinder::OnIndexedFrequency(
     return;
   }
 
-  // Run over the BB frequency data and mark non-zero frequency BBs as having
-  // been visited.
-  for (size_t bb_index = 0; bb_index < data->num_entries; ++bb_index) {
-    uint32 bb_freq = GetFrequency(data, bb_index, 0);
-
-    if (bb_freq == 0)
-      continue;
-
-    // Mark this basic-block as visited.
-    const RelativeAddressRange& bb_range = pdb_info->bb_ranges[bb_index];
-    if (!pdb_info->line_info.Visit(bb_range.start(),
-                                   bb_range.size(),
-                                   bb_freq)) {
-      LOG(ERROR) << "Failed to visit BB at " << bb_range << ".";
-      event_handler_errored_ = true;
-      return;
-    }
+  // Mark the non-zero frequency basic-blocks as visited in a single pass over
+  // the line information. The index of the module yields them in address
+  // order.
+  if (!pdb_info->bb_range_index.VisitLines(data, &pdb_info->line_info)) {
+    LOG(ERROR) << "Failed to visit the basic blocks.";
+    event_handler_errored_ = true;
+    return;
   }
 }
 
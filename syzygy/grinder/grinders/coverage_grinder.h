@@ -35,6 +35,8 @@ class CoverageGrinder : public GrinderInterface {
   // @{
   virtual bool ParseCommandLine(const CommandLine* command_line) OVERRIDE;
   virtual void SetParser(Parser* parser) OVERRIDE;
+  virtual bool LoadData(const base::FilePath& path) OVERRIDE;
+  virtual bool Merge(GrinderInterface* other) OVERRIDE;
   virtual bool Grind() OVERRIDE;
   virtual bool OutputData(FILE* file) OVERRIDE;
   // @}
@@ -65,9 +67,10 @@ class CoverageGrinder : public GrinderInterface {
   // OnIndexedFrequency.
   basic_block_util::PdbInfoMap pdb_info_cache_;
 
-  // Stores the final coverage data, populated by Grind. Contains an aggregate
-  // of all LineInfo objects stored in the pdb_info_map_, in a reverse map
-  // (where efficient lookup is by file name and line number).
+  // Stores the final coverage data, populated by Merge and Grind. Contains an
+  // aggregate of all LineInfo objects stored in the pdb_info_map_ of this and
+  // any merged grinder, in a reverse map (where efficient lookup is by file
+  // name and line number).
   CoverageData coverage_data_;
 
   // Points to the parser that is feeding us events. Used to get module
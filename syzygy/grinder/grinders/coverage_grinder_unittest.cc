@@ -16,6 +16,7 @@
 
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
+#include "syzygy/grinder/lcov_writer.h"
 #include "syzygy/pe/unittest_util.h"
 
 namespace grinder {
@@ -129,5 +130,85 @@ TEST_F(CoverageGrinderTest, GrindAndOutputCacheGrindDataSucceeds) {
   // TODO(chrisha): Validate the output is a valid CacheGrind file.
 }
 
+TEST_F(CoverageGrinderTest, MergeAccumulatesVisitCounts) {
+  // A reference grinder that sees the trace file once.
+  TestCoverageGrinder reference;
+  reference.ParseCommandLine(&cmd_line_);
+  ASSERT_NO_FATAL_FAILURE(InitParser(&reference));
+  reference.SetParser(&parser_);
+  ASSERT_TRUE(parser_.Consume());
+  ASSERT_TRUE(reference.Grind());
+
+  // Two grinders that each see the trace file once, through parsers of their
+  // own, and that are then merged.
+  TestCoverageGrinder grinders[2];
+  trace::parser::Parser parsers[2];
+  base::FilePath trace_file =
+      testing::GetExeTestDataRelativePath(testing::kCoverageTraceFiles[0]);
+  for (size_t i = 0; i < arraysize(grinders); ++i) {
+    grinders[i].ParseCommandLine(&cmd_line_);
+    ASSERT_TRUE(parsers[i].Init(&grinders[i]));
+    grinders[i].SetParser(&parsers[i]);
+    ASSERT_TRUE(parsers[i].OpenTraceFile(trace_file));
+    ASSERT_TRUE(parsers[i].Consume());
+  }
+  ASSERT_TRUE(grinders[0].Merge(&grinders[1]));
+  ASSERT_TRUE(grinders[0].Grind());
+
+  // The merged grinder should have seen every line twice as often.
+  const CoverageData& expected = reference.coverage_data();
+  const CoverageData& merged = grinders[0].coverage_data();
+  ASSERT_EQ(expected.source_files().size(),
+            merged.source_files().size());
+  CoverageData::SourceFileIdMap::const_iterator expected_it =
+      expected.source_file_ids().begin();
+  for (; expected_it != expected.source_file_ids().end(); ++expected_it) {
+    const CoverageData::SourceFileCoverageData& expected_file =
+        expected.source_files()[expected_it->second];
+    const CoverageData::SourceFileCoverageData* merged_file =
+        merged.FindSourceFile(expected_it->first);
+    ASSERT_TRUE(merged_file != NULL);
+    ASSERT_EQ(expected_file.instrumented_lines,
+              merged_file->instrumented_lines);
+    for (size_t i = 0; i < expected_file.line_execution_counts.size(); ++i) {
+      EXPECT_EQ(2 * expected_file.line_execution_counts[i],
+                merged_file->line_execution_counts[i]);
+    }
+  }
+}
+
+TEST_F(CoverageGrinderTest, LoadDataAddsPreviousOutput) {
+  // A previous output holding a line that isn't covered by the trace file.
+  testing::ScopedTempFile previous_path;
+  CoverageData previous;
+  previous.AddLine("C:\\src\\previous.cc", 1, 3);
+  ASSERT_TRUE(WriteLcovCoverageFile(previous, previous_path.path()));
+
+  TestCoverageGrinder grinder;
+  grinder.ParseCommandLine(&cmd_line_);
+  ASSERT_TRUE(grinder.LoadData(previous_path.path()));
+  ASSERT_NO_FATAL_FAILURE(InitParser(&grinder));
+  grinder.SetParser(&parser_);
+  ASSERT_TRUE(parser_.Consume());
+  ASSERT_TRUE(grinder.Grind());
+
+  const CoverageData& coverage = grinder.coverage_data();
+  EXPECT_LT(1U, coverage.source_files().size());
+  const CoverageData::SourceFileCoverageData* previous_file =
+      coverage.FindSourceFile("C:\\src\\previous.cc");
+  ASSERT_TRUE(previous_file != NULL);
+  EXPECT_EQ(1U, previous_file->num_instrumented_lines);
+  ASSERT_TRUE(previous_file->IsInstrumented(1));
+  EXPECT_EQ(3U, previous_file->line_execution_counts[1]);
+}
+
+TEST_F(CoverageGrinderTest, LoadDataFailsOnMissingFile) {
+  TestCoverageGrinder grinder;
+  grinder.ParseCommandLine(&cmd_line_);
+  testing::ScopedTempFile missing_path;
+  ASSERT_TRUE(file_util::Delete(missing_path.path(), false));
+  EXPECT_FALSE(grinder.LoadData(missing_path.path()));
+}
+
 }  // namespace grinders
 }  // namespace grinder
@@ -14,8 +14,13 @@
 
 #include "syzygy/grinder/grinders/indexed_frequency_data_grinder.h"
 
+#include <algorithm>
 #include <limits>
+#include <map>
+#include <vector>
 
+#include "base/string_number_conversions.h"
+#include "base/string_util.h"
 #include "base/files/file_path.h"
 #include "base/json/json_reader.h"
 #include "syzygy/common/indexed_frequency_data.h"
@@ -30,14 +35,100 @@
 namespace grinder {
 namespace grinders {
 
+namespace {
+
+using basic_block_util::EntryCountType;
+using basic_block_util::IndexedFrequencyMap;
+using basic_block_util::ModuleInformation;
+
+// A site of a function, with its entry count.
+struct HotSite {
+  Symbolizer::RVA rva;
+  EntryCountType count;
+  const Symbolizer::Symbol* symbol;
+};
+
+// The sites of a function. The sites that couldn't be symbolized are
+// gathered in a function of their own for each module, with no symbol.
+struct HotFunction {
+  HotFunction() : module(NULL), symbol(NULL), total_count(0) {
+  }
+
+  const ModuleInformation* module;
+  const Symbolizer::Symbol* symbol;
+  uint64 total_count;
+  std::vector<HotSite> sites;
+};
+
+// Orders the sites by decreasing count, then by address.
+bool IsHotterSite(const HotSite& site1, const HotSite& site2) {
+  if (site1.count != site2.count)
+    return site1.count > site2.count;
+  return site1.rva < site2.rva;
+}
+
+// Orders the functions by decreasing total count, then by module and by the
+// address of their hottest site.
+bool IsHotterFunction(const HotFunction* function1,
+                      const HotFunction* function2) {
+  if (function1->total_count != function2->total_count)
+    return function1->total_count > function2->total_count;
+  if (function1->module->image_file_name !=
+          function2->module->image_file_name) {
+    return function1->module->image_file_name <
+        function2->module->image_file_name;
+  }
+  return function1->sites.front().rva < function2->sites.front().rva;
+}
+
+}  // namespace
+
+const size_t IndexedFrequencyDataGrinder::kDefaultHotSitesPerFunction;
+
 IndexedFrequencyDataGrinder::IndexedFrequencyDataGrinder()
     : parser_(NULL),
-      event_handler_errored_(false) {
+      event_handler_errored_(false),
+      output_format_(kJsonFormat),
+      hot_sites_per_function_(kDefaultHotSitesPerFunction) {
 }
 
 bool IndexedFrequencyDataGrinder::ParseCommandLine(
     const CommandLine* command_line) {
   serializer_.set_pretty_print(command_line->HasSwitch("pretty-print"));
+
+  const char kHotSitesPerFunction[] = "hot-sites-per-function";
+  if (command_line->HasSwitch(kHotSitesPerFunction)) {
+    std::string count_str =
+        command_line->GetSwitchValueASCII(kHotSitesPerFunction);
+    if (!base::StringToSizeT(count_str, &hot_sites_per_function_) ||
+        hot_sites_per_function_ == 0) {
+      LOG(ERROR) << "Invalid " << kHotSitesPerFunction << " value: "
+                 << count_str << ".";
+      return false;
+    }
+  }
+
+  base::FilePath cache_dir =
+      command_line->GetSwitchValuePath("symbol-cache-dir");
+  if (cache_dir.empty())
+    Symbolizer::GetCacheDirFromEnvironment(&cache_dir);
+  symbolizer_.set_cache_dir(cache_dir);
+
+  const char kOutputFormat[] = "output-format";
+  if (!command_line->HasSwitch(kOutputFormat))
+    return true;
+
+  std::string format = command_line->GetSwitchValueASCII(kOutputFormat);
+  if (LowerCaseEqualsASCII(format, "json")) {
+    output_format_ = kJsonFormat;
+  } else if (LowerCaseEqualsASCII(format, "binary")) {
+    output_format_ = kBinaryFormat;
+  } else if (LowerCaseEqualsASCII(format, "hot-sites")) {
+    output_format_ = kHotSitesFormat;
+  } else {
+    LOG(ERROR) << "Unknown output format: " << format << ".";
+    return false;
+  }
   return true;
 }
 
@@ -46,6 +137,32 @@ void IndexedFrequencyDataGrinder::SetParser(Parser* parser) {
   parser_ = parser;
 }
 
+bool IndexedFrequencyDataGrinder::LoadData(const base::FilePath& path) {
+  ModuleIndexedFrequencyMap frequency_data_map;
+  if (!serializer_.Load(path, &frequency_data_map)) {
+    LOG(ERROR) << "Failed to load frequency data from: " << path.value();
+    return false;
+  }
+
+  return MergeFrequencyData(frequency_data_map);
+}
+
+bool IndexedFrequencyDataGrinder::Merge(GrinderInterface* other) {
+  DCHECK(other != NULL);
+  IndexedFrequencyDataGrinder* other_grinder =
+      static_cast<IndexedFrequencyDataGrinder*>(other);
+
+  if (other_grinder->event_handler_errored_)
+    event_handler_errored_ = true;
+
+  // Keep the instrumented module information around so that we don't need to
+  // reload it should we receive more events for these modules.
+  instrumented_modules_.insert(other_grinder->instrumented_modules_.begin(),
+                               other_grinder->instrumented_modules_.end());
+
+  return MergeFrequencyData(other_grinder->frequency_data_map_);
+}
+
 bool IndexedFrequencyDataGrinder::Grind() {
   if (frequency_data_map_.empty()) {
     LOG(ERROR) << "No basic-block frequency data was encountered.";
@@ -57,8 +174,118 @@ bool IndexedFrequencyDataGrinder::Grind() {
 
 bool IndexedFrequencyDataGrinder::OutputData(FILE* file) {
   DCHECK(file != NULL);
-  if (!serializer_.SaveAsJson(frequency_data_map_, file))
+  switch (output_format_) {
+    case kJsonFormat:
+      return serializer_.SaveAsJson(frequency_data_map_, file);
+
+    case kBinaryFormat:
+      return serializer_.SaveAsBinary(frequency_data_map_, file);
+
+    case kHotSitesFormat:
+      return OutputHotSites(file);
+
+    default: NOTREACHED() << "Unknown OutputFormat.";
+  }
+
+  return false;
+}
+
+bool IndexedFrequencyDataGrinder::OutputHotSites(FILE* file) {
+  DCHECK(file != NULL);
+
+  // The sites are the entries of the first column, which holds the entry
+  // counts of both the basic-block entry and the branch frequencies.
+  ModuleIndexedFrequencyMap::const_iterator module_it =
+      frequency_data_map_.begin();
+  for (; module_it != frequency_data_map_.end(); ++module_it) {
+    const IndexedFrequencyMap& frequencies = module_it->second.frequency_map;
+    IndexedFrequencyMap::const_iterator it = frequencies.begin();
+    for (; it != frequencies.end(); ++it) {
+      if (it->first.second == 0 && it->second > 0)
+        symbolizer_.AddRVA(module_it->first, it->first.first.value());
+    }
+  }
+  if (!symbolizer_.Resolve())
     return false;
+
+  // Gather the sites by function.
+  typedef std::pair<const ModuleInformation*, Symbolizer::RVA> FunctionKey;
+  std::map<FunctionKey, HotFunction> function_map;
+  for (module_it = frequency_data_map_.begin();
+       module_it != frequency_data_map_.end(); ++module_it) {
+    const ModuleInformation* module = &module_it->first;
+    const IndexedFrequencyMap& frequencies = module_it->second.frequency_map;
+    IndexedFrequencyMap::const_iterator it = frequencies.begin();
+    for (; it != frequencies.end(); ++it) {
+      if (it->first.second != 0 || it->second <= 0)
+        continue;
+
+      HotSite site = { it->first.first.value(), it->second, NULL };
+      site.symbol = symbolizer_.FindSymbol(*module, site.rva);
+      if (site.symbol != NULL && !site.symbol->IsValid())
+        site.symbol = NULL;
+
+      // The unsymbolized sites all go to function zero of their module.
+      Symbolizer::RVA function_rva =
+          site.symbol != NULL ? site.symbol->function_rva : 0;
+      HotFunction& function =
+          function_map[std::make_pair(module, function_rva)];
+      function.module = module;
+      if (function_rva != 0)
+        function.symbol = site.symbol;
+      function.total_count += site.count;
+      function.sites.push_back(site);
+    }
+  }
+
+  std::vector<HotFunction*> functions;
+  functions.reserve(function_map.size());
+  std::map<FunctionKey, HotFunction>::iterator function_it =
+      function_map.begin();
+  for (; function_it != function_map.end(); ++function_it) {
+    std::sort(function_it->second.sites.begin(),
+              function_it->second.sites.end(),
+              IsHotterSite);
+    functions.push_back(&function_it->second);
+  }
+  std::sort(functions.begin(), functions.end(), IsHotterFunction);
+
+  if (::fprintf(file,
+                "Module, Function, Function Count, RVA, Count, File, "
+                "Line\n") <= 0) {
+    return false;
+  }
+  for (size_t i = 0; i < functions.size(); ++i) {
+    const HotFunction& function = *functions[i];
+    std::wstring module_name =
+        base::FilePath(function.module->image_file_name).BaseName().value();
+    const wchar_t* function_name = function.symbol != NULL ?
+        function.symbol->function_name.c_str() : L"<unknown>";
+
+    size_t site_count =
+        std::min(function.sites.size(), hot_sites_per_function_);
+    for (size_t j = 0; j < site_count; ++j) {
+      const HotSite& site = function.sites[j];
+      const wchar_t* file_name = L"";
+      size_t line = 0;
+      if (site.symbol != NULL) {
+        file_name = site.symbol->file_name.c_str();
+        line = site.symbol->line;
+      }
+      if (::fprintf(file,
+                    "\"%ls\", \"%ls\", %llu, 0x%08X, %d, \"%ls\", %u\n",
+                    module_name.c_str(),
+                    function_name,
+                    function.total_count,
+                    site.rva,
+                    site.count,
+                    file_name,
+                    line) <= 0) {
+        return false;
+      }
+    }
+  }
+
   return true;
 }
 
@@ -71,6 +298,16 @@ void IndexedFrequencyDataGrinder::OnIndexedFrequency(
   DCHECK(parser_ != NULL);
   DCHECK_NE(0U, data->num_columns);
 
+  // The entries of the edge and page coverage bitmaps aren't basic blocks.
+  if (data->data_type == common::IndexedFrequencyData::EDGE_COVERAGE) {
+    LOG(INFO) << "Skipping edge coverage data.";
+    return;
+  }
+  if (data->data_type == common::IndexedFrequencyData::PAGE_COVERAGE) {
+    LOG(INFO) << "Skipping page coverage data.";
+    return;
+  }
+
   if (data->num_entries == 0) {
     LOG(INFO) << "Skipping empty basic block frequency data.";
     return;
@@ -143,15 +380,17 @@ void IndexedFrequencyDataGrinder::UpdateBasicBlockFrequencyData(
                        info)).first;
   }
 
-  // Validate fields are compatible to be grinded together.
+  // Validate fields are compatible to be grinded together. The overflows of
+  // narrow counters get spilled by the agent to records of wider counters, so
+  // the records of a module may have various frequency sizes.
   IndexedFrequencyInformation& info = look->second;
   if (info.num_entries != data->num_entries ||
       info.num_columns != data->num_columns ||
-      info.frequency_size != data->frequency_size ||
       info.data_type != data->data_type) {
     event_handler_errored_ = true;
     return;
   }
+  info.frequency_size = std::max(info.frequency_size, data->frequency_size);
 
   // Run over the BB frequency data and increment values for each basic block
   // using saturation arithmetic.
@@ -225,5 +464,48 @@ IndexedFrequencyDataGrinder::FindOrCreateInstrumentedModule(
   return &info;
 }
 
+bool IndexedFrequencyDataGrinder::MergeFrequencyData(
+    const ModuleIndexedFrequencyMap& frequency_data_map) {
+  using basic_block_util::EntryCountType;
+  using basic_block_util::IndexedFrequencyInformation;
+  using basic_block_util::IndexedFrequencyMap;
+
+  ModuleIndexedFrequencyMap::const_iterator other_it =
+      frequency_data_map.begin();
+  for (; other_it != frequency_data_map.end(); ++other_it) {
+    std::pair<ModuleIndexedFrequencyMap::iterator, bool> result =
+        frequency_data_map_.insert(*other_it);
+    if (result.second)
+      continue;
+
+    // Validate fields are compatible to be merged together. The counters of
+    // a module may come in various sizes, as the agent spills the overflows
+    // of narrow counters to wider ones.
+    IndexedFrequencyInformation& info = result.first->second;
+    const IndexedFrequencyInformation& other_info = other_it->second;
+    if (info.num_entries != other_info.num_entries ||
+        info.num_columns != other_info.num_columns ||
+        info.data_type != other_info.data_type) {
+      LOG(ERROR) << "Inconsistent frequency data for module "
+                 << other_it->first.image_file_name << ".";
+      return false;
+    }
+    info.frequency_size = std::max(info.frequency_size,
+                                   other_info.frequency_size);
+
+    // Sum up the frequencies using saturation arithmetic.
+    IndexedFrequencyMap::const_iterator entry_it =
+        other_info.frequency_map.begin();
+    for (; entry_it != other_info.frequency_map.end(); ++entry_it) {
+      EntryCountType& value = info.frequency_map[entry_it->first];
+      value += std::min(
+          entry_it->second,
+          std::numeric_limits<EntryCountType>::max() - value);
+    }
+  }
+
+  return true;
+}
+
 }  // namespace grinders
 }  // namespace grinder
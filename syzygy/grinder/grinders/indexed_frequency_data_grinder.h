@@ -25,6 +25,7 @@
 #include "syzygy/grinder/basic_block_util.h"
 #include "syzygy/grinder/grinder.h"
 #include "syzygy/grinder/indexed_frequency_data_serializer.h"
+#include "syzygy/grinder/symbolizer.h"
 
 namespace grinder {
 namespace grinders {
@@ -36,7 +37,15 @@ namespace grinders {
 // See indexed_frequency_data_serializer.h for the resulting JSON structure.
 //
 // The JSON output will be pretty printed if --pretty-print is included in the
-// command line passed to ParseCommandLine().
+// command line passed to ParseCommandLine(). The data is output in the binary
+// format of IndexedFrequencyDataSerializer instead if --output-format=binary
+// is included.
+//
+// With --output-format=hot-sites, the entry counts are instead symbolized and
+// output in CSV format, grouped by function: the functions by decreasing
+// total count, each with its --hot-sites-per-function hottest sites. The sites
+// are basic blocks, or the Asan check sites of a module instrumented with
+// --count-checks.
 class IndexedFrequencyDataGrinder : public GrinderInterface {
  public:
   typedef basic_block_util::ModuleIndexedFrequencyMap ModuleIndexedFrequencyMap;
@@ -47,6 +56,8 @@ class IndexedFrequencyDataGrinder : public GrinderInterface {
   // @{
   virtual bool ParseCommandLine(const CommandLine* command_line) OVERRIDE;
   virtual void SetParser(Parser* parser) OVERRIDE;
+  virtual bool LoadData(const base::FilePath& path) OVERRIDE;
+  virtual bool Merge(GrinderInterface* other) OVERRIDE;
   virtual bool Grind() OVERRIDE;
   virtual bool OutputData(FILE* file) OVERRIDE;
   // @}
@@ -63,6 +74,18 @@ class IndexedFrequencyDataGrinder : public GrinderInterface {
       const TraceIndexedFrequencyData* data) OVERRIDE;
   // @}
 
+  enum OutputFormat {
+    kJsonFormat,
+    kBinaryFormat,
+    kHotSitesFormat,
+  };
+
+  // The default number of sites output per function in hot-sites format.
+  static const size_t kDefaultHotSitesPerFunction = 10;
+
+  OutputFormat output_format() const { return output_format_; }
+  size_t hot_sites_per_function() const { return hot_sites_per_function_; }
+
   // @returns a map from ModuleInformation records to basic block frequencies.
   const ModuleIndexedFrequencyMap& frequency_data_map() const {
     return frequency_data_map_;
@@ -107,6 +130,18 @@ class IndexedFrequencyDataGrinder : public GrinderInterface {
   const InstrumentedModuleInformation* FindOrCreateInstrumentedModule(
       const ModuleInformation* module_info);
 
+  // Adds the frequencies of @p frequency_data_map to those of this grinder.
+  // @param frequency_data_map the frequencies to be added.
+  // @returns true on success, false if the frequencies of a module aren't
+  //     compatible with those already held for it.
+  bool MergeFrequencyData(const ModuleIndexedFrequencyMap& frequency_data_map);
+
+  // Symbolizes the entry counts and outputs the hottest sites of each function
+  // to @p file in CSV format.
+  // @param file the file to write to.
+  // @returns true on success, false otherwise.
+  bool OutputHotSites(FILE* file);
+
   // Stores the summarized basic-block frequencies for each module encountered.
   ModuleIndexedFrequencyMap frequency_data_map_;
 
@@ -125,6 +160,17 @@ class IndexedFrequencyDataGrinder : public GrinderInterface {
   // continue with a warning that results may be partial.
   bool event_handler_errored_;
 
+  // The output format to use.
+  OutputFormat output_format_;
+
+  // @name Hot-sites format state.
+  // @{
+  // The maximum number of sites output for each function.
+  size_t hot_sites_per_function_;
+  // Resolves the sites to their functions and source lines.
+  Symbolizer symbolizer_;
+  // @}
+
  private:
   DISALLOW_COPY_AND_ASSIGN(IndexedFrequencyDataGrinder);
 };
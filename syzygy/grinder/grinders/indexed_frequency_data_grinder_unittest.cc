@@ -14,10 +14,13 @@
 
 #include "syzygy/grinder/grinders/indexed_frequency_data_grinder.h"
 
+#include <vector>
+
 #include "base/file_util.h"
 #include "base/values.h"
 #include "base/files/scoped_temp_dir.h"
 #include "base/json/json_reader.h"
+#include "base/strings/string_split.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/common/indexed_frequency_data.h"
@@ -62,6 +65,7 @@ class TestIndexedFrequencyDataGrinder : public IndexedFrequencyDataGrinder {
  public:
   using IndexedFrequencyDataGrinder::UpdateBasicBlockFrequencyData;
   using IndexedFrequencyDataGrinder::InstrumentedModuleInformation;
+  using IndexedFrequencyDataGrinder::event_handler_errored_;
   using IndexedFrequencyDataGrinder::parser_;
 };
 
@@ -223,6 +227,44 @@ TEST_F(IndexedFrequencyDataGrinderTest, ParseCommandLineSucceeds) {
   EXPECT_TRUE(grinder2.ParseCommandLine(&cmd_line_));
 }
 
+TEST_F(IndexedFrequencyDataGrinderTest, ParseOutputFormat) {
+  TestIndexedFrequencyDataGrinder grinder1;
+  EXPECT_TRUE(grinder1.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(IndexedFrequencyDataGrinder::kJsonFormat,
+            grinder1.output_format());
+
+  TestIndexedFrequencyDataGrinder grinder2;
+  cmd_line_.AppendSwitchASCII("output-format", "binary");
+  EXPECT_TRUE(grinder2.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(IndexedFrequencyDataGrinder::kBinaryFormat,
+            grinder2.output_format());
+
+  TestIndexedFrequencyDataGrinder grinder3;
+  cmd_line_.AppendSwitchASCII("output-format", "foobar");
+  EXPECT_FALSE(grinder3.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(IndexedFrequencyDataGrinderTest, ParseHotSitesOptions) {
+  cmd_line_.AppendSwitchASCII("output-format", "hot-sites");
+  TestIndexedFrequencyDataGrinder grinder1;
+  EXPECT_TRUE(grinder1.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(IndexedFrequencyDataGrinder::kHotSitesFormat,
+            grinder1.output_format());
+  EXPECT_EQ(IndexedFrequencyDataGrinder::kDefaultHotSitesPerFunction,
+            grinder1.hot_sites_per_function());
+
+  CommandLine cmd_line2(cmd_line_);
+  cmd_line2.AppendSwitchASCII("hot-sites-per-function", "3");
+  TestIndexedFrequencyDataGrinder grinder2;
+  EXPECT_TRUE(grinder2.ParseCommandLine(&cmd_line2));
+  EXPECT_EQ(3U, grinder2.hot_sites_per_function());
+
+  CommandLine cmd_line3(cmd_line_);
+  cmd_line3.AppendSwitchASCII("hot-sites-per-function", "0");
+  TestIndexedFrequencyDataGrinder grinder3;
+  EXPECT_FALSE(grinder3.ParseCommandLine(&cmd_line3));
+}
+
 TEST_F(IndexedFrequencyDataGrinderTest, SetParserSucceeds) {
   TestIndexedFrequencyDataGrinder grinder;
 
@@ -289,6 +331,11 @@ TEST_F(IndexedFrequencyDataGrinderTest, UpdateBasicBlockFrequencyData) {
   CreateExpectedCounts(3, &expected_counts);
   EXPECT_THAT(grinder.frequency_data_map().begin()->second,
               testing::ContainerEq(expected_counts));
+
+  // Records of various frequency sizes are summed up, and the module keeps
+  // the widest of them.
+  EXPECT_FALSE(grinder.event_handler_errored_);
+  EXPECT_EQ(4U, grinder.frequency_data_map().begin()->second.frequency_size);
 }
 
 TEST_F(IndexedFrequencyDataGrinderTest, GrindBranchEntryDataSucceeds) {
@@ -298,6 +345,71 @@ TEST_F(IndexedFrequencyDataGrinderTest, GrindBranchEntryDataSucceeds) {
   // TODO(rogerm): Inspect value for bb-entry specific expected data.
 }
 
+TEST_F(IndexedFrequencyDataGrinderTest, GrindHotSitesSucceeds) {
+  cmd_line_.AppendSwitchASCII("output-format", "hot-sites");
+  cmd_line_.AppendSwitchASCII("hot-sites-per-function", "2");
+
+  TestIndexedFrequencyDataGrinder grinder;
+  ASSERT_TRUE(grinder.ParseCommandLine(&cmd_line_));
+  ASSERT_NO_FATAL_FAILURE(InitParser(&grinder, testing::kBranchTraceFiles[0]));
+  grinder.SetParser(&parser_);
+  ASSERT_TRUE(parser_.Consume());
+  ASSERT_TRUE(grinder.Grind());
+
+  base::FilePath csv_path;
+  {
+    file_util::ScopedFILE csv_file(
+        CreateAndOpenTemporaryFileInDir(temp_dir_.path(), &csv_path));
+    ASSERT_TRUE(csv_file.get() != NULL);
+    ASSERT_TRUE(grinder.OutputData(csv_file.get()));
+  }
+
+  std::string csv;
+  ASSERT_TRUE(file_util::ReadFileToString(csv_path, &csv));
+  std::vector<std::string> lines;
+  base::SplitString(csv, '\n', &lines);
+  ASSERT_LT(2U, lines.size());
+  EXPECT_EQ("Module, Function, Function Count, RVA, Count, File, Line",
+            lines[0]);
+
+  // Each site is on a line of its own, starting with the quoted module name.
+  for (size_t i = 1; i < lines.size(); ++i) {
+    if (!lines[i].empty())
+      EXPECT_EQ('"', lines[i][0]);
+  }
+}
+
+TEST_F(IndexedFrequencyDataGrinderTest, LoadDataAccumulatesFrequencies) {
+  base::FilePath json_path;
+  ASSERT_NO_FATAL_FAILURE(
+      GrindTraceFileToJson(testing::kBranchTraceFiles[0], &json_path));
+  ModuleIndexedFrequencyMap expected;
+  ASSERT_NO_FATAL_FAILURE(LoadJson(json_path, &expected));
+  ASSERT_FALSE(expected.empty());
+
+  // Loading the same output twice should double every frequency.
+  TestIndexedFrequencyDataGrinder grinder;
+  ASSERT_TRUE(grinder.ParseCommandLine(&cmd_line_));
+  ASSERT_TRUE(grinder.LoadData(json_path));
+  ASSERT_TRUE(grinder.LoadData(json_path));
+  ASSERT_TRUE(grinder.Grind());
+
+  ModuleIndexedFrequencyMap::iterator module_it = expected.begin();
+  for (; module_it != expected.end(); ++module_it) {
+    IndexedFrequencyMap& frequency_map = module_it->second.frequency_map;
+    IndexedFrequencyMap::iterator entry_it = frequency_map.begin();
+    for (; entry_it != frequency_map.end(); ++entry_it)
+      entry_it->second *= 2;
+  }
+  EXPECT_THAT(grinder.frequency_data_map(), testing::ContainerEq(expected));
+}
+
+TEST_F(IndexedFrequencyDataGrinderTest, LoadDataFailsOnMissingFile) {
+  TestIndexedFrequencyDataGrinder grinder;
+  ASSERT_TRUE(grinder.ParseCommandLine(&cmd_line_));
+  EXPECT_FALSE(grinder.LoadData(temp_dir_.path().Append(L"missing.json")));
+}
+
 
 }  // namespace grinders
 }  // namespace grinder
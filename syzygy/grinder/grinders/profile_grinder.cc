@@ -19,15 +19,10 @@
 #include "base/string_util.h"
 #include "base/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
-#include "base/win/scoped_bstr.h"
-#include "sawbuck/common/com_utils.h"
-#include "syzygy/pe/find.h"
 
 namespace grinder {
 namespace grinders {
 
-using base::win::ScopedBstr;
-using base::win::ScopedComPtr;
 using trace::parser::AbsoluteAddress64;
 using trace::parser::ParseEventHandler;
 using sym_util::ModuleInformation;
@@ -79,6 +74,13 @@ void ProfileGrinder::CodeLocation::Set(
   symbol_offset_ = 0;
 }
 
+size_t ProfileGrinder::CodeLocation::Hash() const {
+  size_t hash = is_symbol_ ? process_id_ : reinterpret_cast<size_t>(module_);
+  hash = hash * 31 + rva_;
+  hash = hash * 31 + symbol_offset_;
+  return hash * 2 + (is_symbol_ ? 1 : 0);
+}
+
 std::string ProfileGrinder::CodeLocation::ToString() const {
   if (is_symbol()) {
     return base::StringPrintf("Symbol: %d, %d", process_id(), symbol_id());
@@ -142,6 +144,13 @@ ProfileGrinder::~ProfileGrinder() {
 
 bool ProfileGrinder::ParseCommandLine(const CommandLine* command_line) {
   thread_parts_ = command_line->HasSwitch("thread-parts");
+
+  base::FilePath cache_dir =
+      command_line->GetSwitchValuePath("symbol-cache-dir");
+  if (cache_dir.empty())
+    Symbolizer::GetCacheDirFromEnvironment(&cache_dir);
+  symbolizer_.set_cache_dir(cache_dir);
+
   return true;
 }
 
@@ -150,102 +159,80 @@ void ProfileGrinder::SetParser(Parser* parser) {
   parser_ = parser;
 }
 
-bool ProfileGrinder::Grind() {
-  if (!ResolveCallers()) {
-    LOG(ERROR) << "Error resolving callers.";
-    return false;
-  }
-  return true;
+bool ProfileGrinder::LoadData(const base::FilePath& path) {
+  // The KCacheGrind output of the profile grinder is a summary that can't be
+  // turned back into the state it was computed from.
+  LOG(ERROR) << "Incremental grinding is not supported in this mode.";
+  return false;
 }
 
-bool ProfileGrinder::GetSessionForModule(const ModuleInformation* module,
-                                         IDiaSession** session_out) {
-  DCHECK(module != NULL);
-  DCHECK(session_out != NULL);
-  DCHECK(*session_out == NULL);
-
-  ModuleSessionMap::const_iterator it(
-      module_sessions_.find(module));
-
-  if (it == module_sessions_.end()) {
-    ScopedComPtr<IDiaDataSource> source;
-    HRESULT hr = source.CreateInstance(CLSID_DiaSource);
-    if (FAILED(hr)) {
-      LOG(ERROR) << "Failed to create DiaSource: "
-                 << com::LogHr(hr) << ".";
-      return false;
-    }
-
-    pe::PEFile::Signature signature;
-    signature.path = module->image_file_name;
-    signature.base_address = core::AbsoluteAddress(
-        static_cast<uint32>(module->base_address));
-    signature.module_size = module->module_size;
-    signature.module_time_date_stamp = module->time_date_stamp;
-    signature.module_checksum = module->image_checksum;
-
-    base::FilePath module_path;
-    if (!pe::FindModuleBySignature(signature, &module_path) ||
-        module_path.empty()) {
-      LOG(ERROR) << "Unable to find module matching signature.";
-      return false;
-    }
-
-    ScopedComPtr<IDiaSession> new_session;
-    // We first try loading straight-up for the module. If the module is at
-    // this path and the symsrv machinery is available, this will bring that
-    // machinery to bear.
-    // The downside is that if the module at this path does not match the
-    // original module, we may load the wrong symbol information for the
-    // module.
-    hr = source->loadDataForExe(module_path.value().c_str(), NULL, NULL);
-    if (SUCCEEDED(hr)) {
-        hr = source->openSession(new_session.Receive());
-        if (FAILED(hr))
-          LOG(ERROR) << "Failure in openSession: " << com::LogHr(hr) << ".";
-    } else {
-      DCHECK(FAILED(hr));
-
-      base::FilePath pdb_path;
-      if (!pe::FindPdbForModule(module_path, &pdb_path) ||
-          pdb_path.empty()) {
-        LOG(ERROR) << "Unable to find PDB for module \""
-                   << module_path.value() << "\".";
+bool ProfileGrinder::Merge(GrinderInterface* other) {
+  DCHECK(other != NULL);
+  ProfileGrinder* other_grinder = static_cast<ProfileGrinder*>(other);
+  DCHECK_EQ(thread_parts_, other_grinder->thread_parts_);
+
+  dynamic_symbols_.insert(other_grinder->dynamic_symbols_.begin(),
+                          other_grinder->dynamic_symbols_.end());
+  invocation_overheads_.insert(other_grinder->invocation_overheads_.begin(),
+                               other_grinder->invocation_overheads_.end());
+
+  PartDataMap::const_iterator part_it = other_grinder->parts_.begin();
+  for (; part_it != other_grinder->parts_.end(); ++part_it) {
+    const PartData& other_part = part_it->second;
+    PartData* part = FindOrCreatePart(other_part.process_id_,
+                                      other_part.thread_id_);
+    if (part->thread_name_.empty())
+      part->thread_name_ = other_part.thread_name_;
+
+    InvocationNodeMap::const_iterator node_it = other_part.nodes_.begin();
+    for (; node_it != other_part.nodes_.end(); ++node_it) {
+      FunctionLocation function;
+      CanonicalizeLocation(node_it->second.function, &function);
+
+      std::pair<InvocationNodeMap::iterator, bool> result =
+          part->nodes_.insert(std::make_pair(function, InvocationNode()));
+      InvocationNode& node = result.first->second;
+      if (result.second) {
+        node.function = function;
+        node.metrics = node_it->second.metrics;
+      } else {
+        AggregateMetrics(node_it->second.metrics, &node.metrics);
       }
+    }
 
-      hr = source->loadDataFromPdb(pdb_path.value().c_str());
-      if (SUCCEEDED(hr)) {
-        hr = source->openSession(new_session.Receive());
-        if (FAILED(hr))
-          LOG(ERROR) << "Failure in openSession: " << com::LogHr(hr) << ".";
+    InvocationEdgeMap::const_iterator edge_it = other_part.edges_.begin();
+    for (; edge_it != other_part.edges_.end(); ++edge_it) {
+      FunctionLocation function;
+      CallerLocation caller;
+      CanonicalizeLocation(edge_it->second.function, &function);
+      CanonicalizeLocation(edge_it->second.caller, &caller);
+
+      InvocationEdgeKey key(function, caller);
+      std::pair<InvocationEdgeMap::iterator, bool> result =
+          part->edges_.insert(std::make_pair(key, InvocationEdge()));
+      InvocationEdge& edge = result.first->second;
+      if (result.second) {
+        edge.function = function;
+        edge.caller = caller;
+        edge.metrics = edge_it->second.metrics;
       } else {
-        LOG(WARNING) << "Failure in loadDataFromPdb('"
-                     << module_path.value().c_str() << "'): "
-                     << com::LogHr(hr) << ".";
+        AggregateMetrics(edge_it->second.metrics, &edge.metrics);
       }
     }
+  }
 
-    DCHECK((SUCCEEDED(hr) && new_session.get() != NULL) ||
-           (FAILED(hr) && new_session.get() == NULL));
+  return true;
+}
 
-    // We store an entry to the cache irrespective of whether we succeeded
-    // in opening a session above. This allows us to cache the failures, which
-    // means we attempt to load each module only once, and consequently log
-    // each failing module only once.
-    it = module_sessions_.insert(
-        std::make_pair(module, new_session)).first;
+bool ProfileGrinder::Grind() {
+  if (!ResolveSymbols()) {
+    LOG(ERROR) << "Error resolving symbols.";
+    return false;
   }
-  DCHECK(it != module_sessions_.end());
-
-  if (it->second.get() == NULL) {
-    // A negative session cache entry - we were previously unable to
-    // load this module.
+  if (!ResolveCallers()) {
+    LOG(ERROR) << "Error resolving callers.";
     return false;
   }
-
-  *session_out = it->second;
-  (*session_out)->AddRef();
-
   return true;
 }
 
@@ -270,32 +257,47 @@ ProfileGrinder::PartData* ProfileGrinder::FindOrCreatePart(DWORD process_id,
   return &it->second;
 }
 
-bool ProfileGrinder::GetFunctionSymbolByRVA(IDiaSession* session,
-                                            RVA address,
-                                            IDiaSymbol** symbol) {
-  DCHECK(session != NULL);
-  DCHECK(symbol != NULL && *symbol == NULL);
-
-  ScopedComPtr<IDiaSymbol> function;
-  HRESULT hr = session->findSymbolByRVA(address,
-                                        SymTagFunction,
-                                        function.Receive());
-  if (FAILED(hr) || function.get() == NULL) {
-    // No private function, let's try for a public symbol.
-    hr = session->findSymbolByRVA(address,
-                                  SymTagPublicSymbol,
-                                  function.Receive());
-    if (FAILED(hr))
-      return false;
+bool ProfileGrinder::ResolveSymbols() {
+  // Queue the distinct module locations of all parts.
+  PartDataMap::const_iterator part_it = parts_.begin();
+  for (; part_it != parts_.end(); ++part_it) {
+    const PartData& part = part_it->second;
+
+    InvocationNodeMap::const_iterator node_it = part.nodes_.begin();
+    for (; node_it != part.nodes_.end(); ++node_it) {
+      const FunctionLocation& function = node_it->first;
+      if (!function.is_symbol() && function.module() != NULL)
+        symbolizer_.AddRVA(*function.module(), function.rva());
+    }
+
+    InvocationEdgeMap::const_iterator edge_it = part.edges_.begin();
+    for (; edge_it != part.edges_.end(); ++edge_it) {
+      const CallerLocation& caller = edge_it->first.second;
+      if (!caller.is_symbol() && caller.module() != NULL)
+        symbolizer_.AddRVA(*caller.module(), caller.rva());
+    }
   }
-  if (function.get() == NULL) {
-    LOG(ERROR) << "NULL function returned from findSymbolByRVA.";
+
+  if (!symbolizer_.Resolve())
     return false;
-  }
 
-  *symbol = function.Detach();
+  // The functions containing the callers need symbolizing too.
+  for (part_it = parts_.begin(); part_it != parts_.end(); ++part_it) {
+    const PartData& part = part_it->second;
+    InvocationEdgeMap::const_iterator edge_it = part.edges_.begin();
+    for (; edge_it != part.edges_.end(); ++edge_it) {
+      const CallerLocation& caller = edge_it->first.second;
+      if (caller.is_symbol() || caller.module() == NULL)
+        continue;
+
+      const Symbolizer::Symbol* symbol =
+          symbolizer_.FindSymbol(*caller.module(), caller.rva());
+      if (symbol != NULL)
+        symbolizer_.AddRVA(*caller.module(), symbol->function_rva);
+    }
+  }
 
-  return true;
+  return symbolizer_.Resolve();
 }
 
 bool ProfileGrinder::GetFunctionForCaller(const CallerLocation& caller,
@@ -322,69 +324,13 @@ bool ProfileGrinder::GetFunctionForCaller(const CallerLocation& caller,
     return true;
   }
 
-  ScopedComPtr<IDiaSession> session;
-  if (!GetSessionForModule(caller.module(), session.Receive()))
-    return false;
-
-  ScopedComPtr<IDiaSymbol> function_sym;
-  if (!GetFunctionSymbolByRVA(session.get(),
-                              caller.rva(),
-                              function_sym.Receive())) {
-    LOG(ERROR) << "No symbol info available for function in module '"
-               << caller.module()->image_file_name << "'";
-  }
-
-  // Get the RVA of the function.
-  DWORD rva = 0;
-  HRESULT hr = function_sym->get_relativeVirtualAddress(&rva);
-  if (FAILED(hr)) {
-    LOG(ERROR) << "Failure in get_relativeVirtualAddress: "
-               << com::LogHr(hr) << ".";
-    return false;
-  }
-
-  // Return the module/rva we found.
-  function->Set(caller.module(), rva);
-
-  ULONGLONG length = 0;
-  hr = function_sym->get_length(&length);
-  if (FAILED(hr)) {
-    LOG(ERROR) << "Failure in get_length: " << com::LogHr(hr) << ".";
+  const Symbolizer::Symbol* symbol =
+      symbolizer_.FindSymbol(*caller.module(), caller.rva());
+  if (symbol == NULL)
     return false;
-  }
 
-  DWORD line_number = 0;
-  if (length != 0) {
-    ScopedComPtr<IDiaEnumLineNumbers> enum_lines;
-
-    hr = session->findLinesByRVA(caller.rva(), length, enum_lines.Receive());
-    if (FAILED(hr)) {
-      LOG(ERROR) << "Failure in findLinesByRVA: " << com::LogHr(hr) << ".";
-      return false;
-    }
-
-    ScopedComPtr<IDiaLineNumber> line;
-    ULONG fetched = 0;
-    hr = enum_lines->Next(1, line.Receive(), &fetched);
-    if (FAILED(hr)) {
-      LOG(ERROR) << "Failure in IDiaLineNumber::Next: "
-                 << com::LogHr(hr) << ".";
-      return false;
-    }
-
-    if (fetched == 1) {
-      hr = line->get_lineNumber(&line_number);
-      if (FAILED(hr)) {
-        LOG(ERROR) << "Failure in get_lineNumber: " << com::LogHr(hr) << ".";
-        return false;
-      }
-    } else if (fetched != 0) {
-      NOTREACHED() << "IDiaLineNumber::Next unexpectedly returned "
-                   << fetched << " elements.";
-    }
-  }
-
-  *line = line_number;
+  function->Set(caller.module(), symbol->function_rva);
+  *line = symbol->line;
   return true;
 }
 
@@ -425,78 +371,17 @@ bool ProfileGrinder::GetInfoForFunction(const FunctionLocation& function,
     return true;
   }
 
-  ScopedComPtr<IDiaSession> session;
-  if (!GetSessionForModule(function.module(), session.Receive()))
-    return false;
-
-  ScopedComPtr<IDiaSymbol> function_sym;
-  if (!GetFunctionSymbolByRVA(session.get(),
-                              function.rva(),
-                              function_sym.Receive())) {
+  const Symbolizer::Symbol* symbol =
+      symbolizer_.FindSymbol(*function.module(), function.rva());
+  if (symbol == NULL) {
     LOG(ERROR) << "No symbol info available for function in module '"
                << function.module()->image_file_name << "'";
     return false;
   }
 
-  ScopedBstr function_name_bstr;
-  HRESULT hr = function_sym->get_name(function_name_bstr.Receive());
-  if (FAILED(hr)) {
-    LOG(ERROR) << "Failure in get_name: " << com::LogHr(hr) << ".";
-    return false;
-  }
-
-  *function_name = com::ToString(function_name_bstr);
-
-  ULONGLONG length = 0;
-  hr = function_sym->get_length(&length);
-  if (FAILED(hr)) {
-    LOG(ERROR) << "Failure in get_length: " << com::LogHr(hr) << ".";
-    return false;
-  }
-
-  ScopedBstr file_name_bstr;
-  DWORD line_number = 0;
-  if (length != 0) {
-    ScopedComPtr<IDiaEnumLineNumbers> enum_lines;
-
-    hr = session->findLinesByRVA(function.rva(),
-                                 length,
-                                 enum_lines.Receive());
-    if (FAILED(hr)) {
-      LOG(ERROR) << "Failure in findLinesByRVA: " << com::LogHr(hr) << ".";
-      return false;
-    }
-
-    ScopedComPtr<IDiaLineNumber> line;
-    ULONG fetched = 0;
-    hr = enum_lines->Next(1, line.Receive(), &fetched);
-    if (FAILED(hr)) {
-      LOG(ERROR) << "Failure in IDialineNumber::Next: "
-                 << com::LogHr(hr) << ".";
-      return false;
-    }
-    if (fetched == 1) {
-      hr = line->get_lineNumber(&line_number);
-      if (FAILED(hr)) {
-        LOG(ERROR) << "Failure in get_lineNumber: " << com::LogHr(hr) << ".";
-        return false;
-      }
-      ScopedComPtr<IDiaSourceFile> source_file;
-      hr = line->get_sourceFile(source_file.Receive());
-      if (FAILED(hr)) {
-        LOG(ERROR) << "Failure in get_sourceFile: " << com::LogHr(hr) << ".";
-        return false;
-      }
-      hr = source_file->get_fileName(file_name_bstr.Receive());
-      if (FAILED(hr)) {
-        LOG(ERROR) << "Failure in get_fileName: " << com::LogHr(hr) << ".";
-        return false;
-      }
-    }
-  }
-
-  *file_name = com::ToString(file_name_bstr);
-  *line = line_number;
+  *function_name = symbol->function_name;
+  *file_name = symbol->file_name;
+  *line = symbol->line;
   return true;
 }
 
@@ -637,9 +522,15 @@ void ProfileGrinder::OnInvocationBatch(base::Time time,
   PartData* part = FindOrCreatePart(process_id, thread_id);
   DCHECK(data != NULL);
 
+  uint64 overhead = 0;
+  InvocationOverheadMap::const_iterator overhead_it =
+      invocation_overheads_.find(process_id);
+  if (overhead_it != invocation_overheads_.end())
+    overhead = overhead_it->second;
+
   // Process and aggregate the individual invocation entries.
   for (size_t i = 0; i < num_invocations; ++i) {
-    const InvocationInfo& info = data->invocations[i];
+    InvocationInfo info = data->invocations[i];
     if (info.caller == NULL || info.function == NULL) {
       // This may happen due to a termination race when the traces are captured.
       LOG(WARNING) << "Empty invocation record. Record " << i << " of " <<
@@ -670,6 +561,9 @@ void ProfileGrinder::OnInvocationBatch(base::Time time,
       ConvertToModuleRVA(process_id, caller_addr, &caller);
     }
 
+    if (overhead != 0)
+      SubtractOverhead(overhead, &info);
+
     AggregateEntryToPart(function, caller, info, part);
   }
 }
@@ -693,6 +587,26 @@ void ProfileGrinder::OnDynamicSymbol(DWORD process_id,
   dynamic_symbols_[key].assign(symbol_name.begin(), symbol_name.end());
 }
 
+void ProfileGrinder::OnProfilerCalibration(
+    base::Time time,
+    DWORD process_id,
+    const TraceProfilerCalibration* data) {
+  DCHECK(data != NULL);
+
+  invocation_overheads_[process_id] = data->invocation_overhead_cycles;
+}
+
+void ProfileGrinder::SubtractOverhead(uint64 overhead, InvocationInfo* info) {
+  DCHECK(info != NULL);
+
+  // Clamp at zero, as timing noise can make individual invocations appear
+  // cheaper than the calibrated overhead.
+  uint64 total_overhead = overhead * info->num_calls;
+  info->cycles_sum -= std::min(info->cycles_sum, total_overhead);
+  info->cycles_min -= std::min(info->cycles_min, overhead);
+  info->cycles_max -= std::min(info->cycles_max, overhead);
+}
+
 void ProfileGrinder::AggregateEntryToPart(const FunctionLocation& function,
                                           const CallerLocation& caller,
                                           const InvocationInfo& info,
@@ -745,6 +659,31 @@ void ProfileGrinder::AggregateEntryToPart(const FunctionLocation& function,
   }
 }
 
+void ProfileGrinder::CanonicalizeLocation(const CodeLocation& location,
+                                          CodeLocation* canonical) {
+  DCHECK(canonical != NULL);
+
+  *canonical = location;
+  if (location.is_symbol() || location.module() == NULL)
+    return;
+
+  ModuleInformationSet::iterator it(modules_.find(*location.module()));
+  if (it == modules_.end())
+    it = modules_.insert(*location.module()).first;
+  DCHECK(it != modules_.end());
+
+  canonical->Set(&(*it), location.rva());
+}
+
+void ProfileGrinder::AggregateMetrics(const Metrics& metrics, Metrics* total) {
+  DCHECK(total != NULL);
+
+  total->num_calls += metrics.num_calls;
+  total->cycles_min = std::min(total->cycles_min, metrics.cycles_min);
+  total->cycles_max = std::max(total->cycles_max, metrics.cycles_max);
+  total->cycles_sum += metrics.cycles_sum;
+}
+
 void ProfileGrinder::ConvertToModuleRVA(uint32 process_id,
                                         AbsoluteAddress64 addr,
                                         CodeLocation* rva) {
@@ -14,13 +14,13 @@
 #ifndef SYZYGY_GRINDER_GRINDERS_PROFILE_GRINDER_H_
 #define SYZYGY_GRINDER_GRINDERS_PROFILE_GRINDER_H_
 
-#include <dia2.h>
 #include <iostream>
 #include <map>
 
+#include "base/hash_tables.h"
 #include "base/files/file_path.h"
-#include "base/win/scoped_comptr.h"
 #include "syzygy/grinder/grinder.h"
+#include "syzygy/grinder/symbolizer.h"
 
 namespace grinder {
 namespace grinders {
@@ -50,11 +50,14 @@ typedef uint32 RVA;
 // the size of the thread-local buffer used to aggregate the data.
 //
 // This class aggregates the data from a trace log, and builds a graph of
-// function nodes and call edges. For each call edge, it aggregates the data
-// from one or more log records, by summing up the call counts and inclusive
-// metrics. For each function node, it also computes the exclusive cost, by
-// summing up the cost of the incoming edges, and subtracting the cost of the
-// outgoing edges.
+// function nodes and call edges, keyed on raw module/RVA locations. For each
+// call edge, it aggregates the data from one or more log records, by summing
+// up the call counts and inclusive metrics. For each function node, it also
+// computes the exclusive cost, by summing up the cost of the incoming edges,
+// and subtracting the cost of the outgoing edges.
+//
+// No symbol information is looked up while aggregating. Instead, all of the
+// distinct locations seen are symbolized in a single batch when grinding.
 //
 // For information on the KCacheGrind file format, see:
 // http://kcachegrind.sourceforge.net/cgi-bin/show.cgi/KcacheGrindCalltreeFormat
@@ -75,6 +78,8 @@ class ProfileGrinder : public GrinderInterface {
   // @{
   virtual bool ParseCommandLine(const CommandLine* command_line) OVERRIDE;
   virtual void SetParser(Parser* parser) OVERRIDE;
+  virtual bool LoadData(const base::FilePath& path) OVERRIDE;
+  virtual bool Merge(GrinderInterface* other) OVERRIDE;
   virtual bool Grind() OVERRIDE;
   virtual bool OutputData(FILE* file) OVERRIDE;
   // @}
@@ -94,6 +99,10 @@ class ProfileGrinder : public GrinderInterface {
   virtual void OnDynamicSymbol(DWORD process_id,
                                uint32 symbol_id,
                                const base::StringPiece& symbol_name) OVERRIDE;
+  virtual void OnProfilerCalibration(
+      base::Time time,
+      DWORD process_id,
+      const TraceProfilerCalibration* data) OVERRIDE;
   // @}
 
  protected:
@@ -114,34 +123,32 @@ class ProfileGrinder : public GrinderInterface {
   struct InvocationNode;
   struct InvocationEdge;
 
+  // Hash comparison functors for use with base::hash_map.
+  struct CodeLocationHashCompare;
+  struct InvocationEdgeKeyHashCompare;
+
   // The key to the dynamic symbol map i
   typedef std::pair<uint32, uint32> DynamicSymbolKey;
   typedef std::map<DynamicSymbolKey, std::string> DynamicSymbolMap;
   typedef std::set<ModuleInformation,
       bool (*)(const ModuleInformation& a, const ModuleInformation& b)>
           ModuleInformationSet;
-  typedef std::map<FunctionLocation, InvocationNode> InvocationNodeMap;
+  typedef base::hash_map<FunctionLocation, InvocationNode,
+                         CodeLocationHashCompare> InvocationNodeMap;
   typedef std::pair<FunctionLocation, CallerLocation> InvocationEdgeKey;
-  typedef std::map<InvocationEdgeKey, InvocationEdge> InvocationEdgeMap;
-
-  typedef base::win::ScopedComPtr<IDiaSession> SessionPtr;
-  typedef std::map<const ModuleInformation*, SessionPtr> ModuleSessionMap;
-
-  bool GetSessionForModule(const ModuleInformation* module,
-                           IDiaSession** session_out);
+  typedef base::hash_map<InvocationEdgeKey, InvocationEdge,
+                         InvocationEdgeKeyHashCompare> InvocationEdgeMap;
 
   // Finds or creates the part data for the given @p thread_id.
   PartData* FindOrCreatePart(DWORD process_id, DWORD thread_id);
 
-  // Retrieves the function containing @p address.
-  // @param symbol on success returns the function's private symbol, or
-  //     public symbol if no private symbol is available.
-  // @returns true on success.
-  bool GetFunctionSymbolByRVA(IDiaSession* session,
-                              RVA address,
-                              IDiaSymbol** symbol);
+  // Symbolizes all of the module locations of the callers and functions
+  // aggregated so far, in a single batch.
+  // @returns true on success, false on failure.
+  bool ResolveSymbols();
 
   // Resolves the function and line number a particular caller belongs to.
+  // Module locations must have been symbolized by ResolveSymbols.
   // @param caller the location of the caller.
   // @param function on success returns the caller's function location.
   // @param line on success returns the caller's line number in @p function.
@@ -149,6 +156,8 @@ class ProfileGrinder : public GrinderInterface {
                             FunctionLocation* function,
                             size_t* line);
 
+  // Retrieves the name and source location of a function. Module locations
+  // must have been symbolized by ResolveSymbols.
   bool GetInfoForFunction(const FunctionLocation& function,
                           std::wstring* function_name,
                           std::wstring* file_name,
@@ -159,6 +168,22 @@ class ProfileGrinder : public GrinderInterface {
                           trace::parser::AbsoluteAddress64 addr,
                           CodeLocation* rva);
 
+  // Converts a code location recorded by another grinder to the equivalent
+  // location in this grinder. Module locations are rebased onto our own
+  // canonical module information.
+  // @param location the code location to convert.
+  // @param canonical on return contains the equivalent location.
+  void CanonicalizeLocation(const CodeLocation& location,
+                            CodeLocation* canonical);
+
+  // Aggregates @p metrics into @p total.
+  static void AggregateMetrics(const Metrics& metrics, Metrics* total);
+
+  // Subtracts the instrumentation overhead from an invocation info.
+  // @param overhead the overhead of a single invocation, in cycles.
+  // @param info the invocation info to adjust.
+  static void SubtractOverhead(uint64 overhead, InvocationInfo* info);
+
   // Aggregates a single invocation info and/or creates a new node and edge.
   void AggregateEntryToPart(const FunctionLocation& function,
                             const CallerLocation& caller,
@@ -179,11 +204,18 @@ class ProfileGrinder : public GrinderInterface {
   // Keeps track of the dynamic symbols seen.
   DynamicSymbolMap dynamic_symbols_;
 
+  // The instrumentation overhead of each process, in cycles per invocation,
+  // as measured by the profiler at startup. This is subtracted from the
+  // invocation costs of the process. The overhead incurred by nested calls
+  // outside of their own measurement window remains attributed to the caller.
+  typedef std::map<uint32, uint64> InvocationOverheadMap;
+  InvocationOverheadMap invocation_overheads_;
+
   // Stores the modules we encounter.
   ModuleInformationSet modules_;
 
-  // Stores the DIA session objects we have going for each module.
-  ModuleSessionMap module_sessions_;
+  // Symbolizes the locations of the callers and functions in modules.
+  Symbolizer symbolizer_;
 
   // The parts we store. If thread_parts_ is false, we store only a single
   // part with id 0. The parts are keyed on process id/thread id.
@@ -195,26 +227,6 @@ class ProfileGrinder : public GrinderInterface {
   bool thread_parts_;
 };
 
-// The data we store for each part.
-struct ProfileGrinder::PartData {
-  PartData();
-
-  // The thread name for this part.
-  std::string thread_name_;
-
-  // The process ID for this part.
-  uint32 process_id_;
-
-  // The thread ID for this part.
-  uint32 thread_id_;
-
-  // Stores the invocation nodes, aka the functions.
-  InvocationNodeMap nodes_;
-
-  // Stores the invocation edges.
-  InvocationEdgeMap edges_;
-};
-
 // A code location is one of two things:
 //
 // 1. An RVA in a module, e.g. a module + offset.
@@ -244,6 +256,9 @@ class ProfileGrinder::CodeLocation {
   // Returns a human-readable string representing this instance.
   std::string ToString() const;
 
+  // Returns a hash of this instance.
+  size_t Hash() const;
+
   // @name Accessors
   // @{
   bool is_symbol() const { return is_symbol_; }
@@ -284,6 +299,18 @@ class ProfileGrinder::CodeLocation {
   bool is_symbol_;
 };
 
+// Hashes and orders code locations, for use with base::hash_map.
+struct ProfileGrinder::CodeLocationHashCompare {
+  static const size_t bucket_size = 4;
+  static const size_t min_buckets = 8;
+  size_t operator()(const CodeLocation& location) const {
+    return location.Hash();
+  }
+  bool operator()(const CodeLocation& a, const CodeLocation& b) const {
+    return a < b;
+  }
+};
+
 // Reprents the address of a function.
 struct ProfileGrinder::FunctionLocation : public ProfileGrinder::CodeLocation {
 };
@@ -292,6 +319,19 @@ struct ProfileGrinder::FunctionLocation : public ProfileGrinder::CodeLocation {
 struct ProfileGrinder::CallerLocation : public ProfileGrinder::CodeLocation {
 };
 
+// Hashes and orders invocation edge keys, for use with base::hash_map.
+struct ProfileGrinder::InvocationEdgeKeyHashCompare {
+  static const size_t bucket_size = 4;
+  static const size_t min_buckets = 8;
+  size_t operator()(const InvocationEdgeKey& key) const {
+    return key.first.Hash() * 31 + key.second.Hash();
+  }
+  bool operator()(const InvocationEdgeKey& a,
+                  const InvocationEdgeKey& b) const {
+    return a < b;
+  }
+};
+
 // The metrics we capture per function and per caller.
 struct ProfileGrinder::Metrics {
   Metrics() : num_calls(0), cycles_min(0), cycles_max(0), cycles_sum(0) {
@@ -338,6 +378,26 @@ struct ProfileGrinder::InvocationEdge {
   InvocationEdge* next_call;
 };
 
+// The data we store for each part.
+struct ProfileGrinder::PartData {
+  PartData();
+
+  // The thread name for this part.
+  std::string thread_name_;
+
+  // The process ID for this part.
+  uint32 process_id_;
+
+  // The thread ID for this part.
+  uint32 thread_id_;
+
+  // Stores the invocation nodes, aka the functions.
+  InvocationNodeMap nodes_;
+
+  // Stores the invocation edges.
+  InvocationEdgeMap edges_;
+};
+
 }  // namespace grinders
 }  // namespace grinder
 
@@ -166,6 +166,7 @@ TEST_F(ProfileGrinderTest, CodeLocation) {
   loc2.Set(&kModuleInfo, kRva);
 
   EXPECT_TRUE(loc1 == loc2);
+  EXPECT_EQ(loc1.Hash(), loc2.Hash());
 }
 
 TEST_F(ProfileGrinderTest, GrindSymbolTestData) {
@@ -189,18 +190,47 @@ TEST_F(ProfileGrinderTest, GrindSymbolTestData) {
   // We get one node for the (unknown) caller, and one for the function called.
   ASSERT_EQ(2, part->nodes_.size());
 
-  TestProfileGrinder::InvocationNodeMap::iterator it = part->nodes_.begin();
+  TestProfileGrinder::FunctionLocation function;
+  function.Set(::GetCurrentProcessId(), kFunctionSymbolId, 0);
+  EXPECT_TRUE(part->nodes_.find(function) != part->nodes_.end());
 
-  EXPECT_TRUE(it->first.is_symbol());
-  EXPECT_EQ(::GetCurrentProcessId(), it->first.process_id());
-  EXPECT_EQ(kFunctionSymbolId, it->first.symbol_id());
+  TestProfileGrinder::FunctionLocation caller_function;
+  caller_function.Set(::GetCurrentProcessId(), kCallerSymbolId, 0);
+  EXPECT_TRUE(part->nodes_.find(caller_function) != part->nodes_.end());
+}
+
+TEST_F(ProfileGrinderTest, SubtractsCalibratedOverhead) {
+  TestProfileGrinder grinder;
+  IssueSetupEvents(&grinder);
+
+  TraceProfilerCalibration calibration = {};
+  calibration.invocation_overhead_cycles = 20;
+  calibration.tsc_read_cycles = 5;
+  calibration.num_processors = 1;
+  grinder.OnProfilerCalibration(base::Time::Now(),
+                                ::GetCurrentProcessId(),
+                                &calibration);
+
+  IssueSymbolInvocationEvent(&grinder);
+  ASSERT_TRUE(grinder.Grind());
+
+  TestProfileGrinder::PartData* part =
+      grinder.FindOrCreatePart(::GetCurrentProcessId(),
+                               ::GetCurrentThreadId());
+  ASSERT_TRUE(part != NULL);
+  ASSERT_EQ(2, part->nodes_.size());
 
-  ++it;
+  TestProfileGrinder::FunctionLocation function;
+  function.Set(::GetCurrentProcessId(), kFunctionSymbolId, 0);
+  TestProfileGrinder::InvocationNodeMap::iterator it =
+      part->nodes_.find(function);
   ASSERT_TRUE(it != part->nodes_.end());
 
-  EXPECT_TRUE(it->first.is_symbol());
-  EXPECT_EQ(::GetCurrentProcessId(), it->first.process_id());
-  EXPECT_EQ(kCallerSymbolId, it->first.symbol_id());
+  // The overhead is taken out of every call, and clamped at zero.
+  EXPECT_EQ(1000, it->second.metrics.num_calls);
+  EXPECT_EQ(0, it->second.metrics.cycles_min);
+  EXPECT_EQ(1000 - 20, it->second.metrics.cycles_max);
+  EXPECT_EQ(1000 * (100 - 20), it->second.metrics.cycles_sum);
 }
 
 TEST_F(ProfileGrinderTest, ParseEmptyCommandLineSucceeds) {
@@ -14,8 +14,13 @@
 
 #include "syzygy/grinder/grinders/sample_grinder.h"
 
+#include "base/string_number_conversions.h"
 #include "base/string_util.h"
 #include "base/stringprintf.h"
+#include "base/utf_string_conversions.h"
+#include "base/memory/scoped_vector.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/block_graph/basic_block_decomposer.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/block_graph/block_util.h"
@@ -44,6 +49,33 @@ core::RelativeAddress GetBucketStart(const TraceSampleData* sample_data) {
           reinterpret_cast<uint32>(sample_data->module_base_addr));
 }
 
+// Upsamples the buckets of @p module_data to the finer @p bucket_size,
+// spreading the value of each bucket evenly over the buckets that replace it.
+void UpsampleBuckets(uint32 bucket_size,
+                     SampleGrinder::ModuleData* module_data) {
+  DCHECK(module_data != NULL);
+  DCHECK_LT(bucket_size, module_data->bucket_size);
+
+  // Grow the buckets in place, and then fill in the scaled values tail first.
+  std::vector<double>& buckets = module_data->buckets;
+  size_t old_size = buckets.size();
+  size_t factor = module_data->bucket_size / bucket_size;
+  size_t new_size = old_size * factor;
+  buckets.resize(new_size);
+  for (size_t i = old_size, j = new_size; i > 0; ) {
+    --i;
+    double new_value = buckets[i] / factor;
+
+    for (size_t k = 0; k < factor; ++k) {
+      --j;
+      buckets[j] = new_value;
+    }
+  }
+
+  // Update the bucket size.
+  module_data->bucket_size = bucket_size;
+}
+
 // Returns the size of an intersection between a given address range and a
 // sample bucket.
 size_t IntersectionSize(const Range& range,
@@ -60,16 +92,22 @@ size_t IntersectionSize(const Range& range,
 bool BuildHeatMapForCodeBlock(const Range& block_range,
                               const BlockGraph::Block* block,
                               core::StringTable* string_table,
+                              base::Lock* string_table_lock,
                               HeatMap* heat_map) {
   DCHECK(block != NULL);
   DCHECK(string_table != NULL);
+  DCHECK(string_table_lock != NULL);
   DCHECK(heat_map != NULL);
   DCHECK_EQ(BlockGraph::CODE_BLOCK, block->type());
 
-  const std::string* compiland = &string_table->InternString(
-      block->compiland_name());
-  const std::string* function = &string_table->InternString(
-      block->name());
+  const std::string* compiland = NULL;
+  const std::string* function = NULL;
+  {
+    // The string table is shared by the modules being ground concurrently.
+    base::AutoLock lock(*string_table_lock);
+    compiland = &string_table->InternString(block->compiland_name());
+    function = &string_table->InternString(block->name());
+  }
   SampleGrinder::BasicBlockData data = { compiland, function, 0.0 };
 
   // If the code block is basic block decomposable then decompose it and
@@ -144,8 +182,10 @@ bool BuildHeatMapForCodeBlock(const Range& block_range,
 bool BuildEmptyHeatMap(const SampleGrinder::ModuleKey& module_key,
                        const SampleGrinder::ModuleData& module_data,
                        core::StringTable* string_table,
+                       base::Lock* string_table_lock,
                        HeatMap* heat_map) {
   DCHECK(string_table != NULL);
+  DCHECK(string_table_lock != NULL);
   DCHECK(heat_map != NULL);
 
   pe::PEFile image;
@@ -182,7 +222,7 @@ bool BuildEmptyHeatMap(const SampleGrinder::ModuleKey& module_key,
       continue;
 
     if (!BuildHeatMapForCodeBlock(block_it->first, block, string_table,
-                                  heat_map)) {
+                                  string_table_lock, heat_map)) {
       return false;
     }
   }
@@ -329,20 +369,163 @@ bool OutputNameHeatMap(SampleGrinder::AggregationLevel aggregation_level,
   return true;
 }
 
+// Returns true if @p module_key identifies the module with the signature
+// @p signature.
+bool ModuleKeyMatches(const SampleGrinder::ModuleKey& module_key,
+                      const pe::PEFile::Signature& signature) {
+  return module_key.module_size == signature.module_size &&
+      module_key.module_checksum == signature.module_checksum &&
+      module_key.module_time_date_stamp == signature.module_time_date_stamp;
+}
+
+// The heat maps of the modules whose functions are used to name the frames
+// of sampled stacks.
+typedef std::map<SampleGrinder::ModuleKey, HeatMap> ModuleHeatMaps;
+
+// Gets the name of a frame of a sampled stack. This is the name of the
+// function containing it if known, and its module and offset or its absolute
+// address otherwise.
+std::string GetStackFrameName(const SampleGrinder::StackFrame& frame,
+                              bool is_return_address,
+                              const SampleGrinder::ModulePathMap& module_paths,
+                              const ModuleHeatMaps& heat_maps) {
+  SampleGrinder::ModulePathMap::const_iterator path_it =
+      module_paths.find(frame.module_key);
+  if (path_it == module_paths.end())
+    return base::StringPrintf("0x%08X", frame.address);
+
+  ModuleHeatMaps::const_iterator heat_map_it =
+      heat_maps.find(frame.module_key);
+  if (heat_map_it != heat_maps.end()) {
+    // A return address refers to the instruction following the call, which
+    // may belong to the next function when the call ends its caller.
+    core::RelativeAddress address(frame.address);
+    if (is_return_address)
+      address -= 1;
+    HeatMap::const_iterator it =
+        heat_map_it->second.FindContaining(Range(address, 1));
+    if (it != heat_map_it->second.end())
+      return *it->second.function;
+  }
+
+  return base::StringPrintf("%s+0x%X",
+      WideToUTF8(path_it->second.BaseName().value()).c_str(),
+      frame.address);
+}
+
+// Output the given @p folded_stacks to the given @p file, one stack per line
+// followed by its number of samples.
+bool OutputFoldedStacks(const SampleGrinder::FoldedStackMap& folded_stacks,
+                        FILE* file) {
+  SampleGrinder::FoldedStackMap::const_iterator it = folded_stacks.begin();
+  for (; it != folded_stacks.end(); ++it) {
+    if (::fprintf(file, "%s %llu\n", it->first.c_str(), it->second) <= 0)
+      return false;
+  }
+  return true;
+}
+
 }  // namespace
 
 // NOTE: This must be kept in sync with SampleGrinder::AggregationLevel.
 const char* SampleGrinder::kAggregationLevelNames[] = {
-    "basic-block", "function", "compiland", "line" };
+    "basic-block", "function", "compiland", "line", "stack" };
 COMPILE_ASSERT(arraysize(SampleGrinder::kAggregationLevelNames) ==
                    SampleGrinder::kAggregationLevelMax,
                AggregationLevelNames_out_of_sync);
 
 const char SampleGrinder::kAggregationLevel[] = "aggregation-level";
+const char SampleGrinder::kGrindThreads[] = "grind-threads";
 const char SampleGrinder::kImage[] = "image";
 
+const size_t SampleGrinder::kMaxGrindThreads = 64;
+
+class SampleGrinder::ModuleGrinder
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  ModuleGrinder(AggregationLevel aggregation_level,
+                const ModuleKey& module_key,
+                const ModuleData& module_data,
+                core::StringTable* string_table,
+                base::Lock* string_table_lock)
+      : aggregation_level_(aggregation_level),
+        module_key_(module_key),
+        module_data_(module_data),
+        string_table_(string_table),
+        string_table_lock_(string_table_lock),
+        succeeded_(false),
+        total_(0.0),
+        orphaned_(0.0) {
+    DCHECK(aggregation_level == kBasicBlock ||
+           aggregation_level == kFunction ||
+           aggregation_level == kCompiland);
+    DCHECK(string_table != NULL);
+    DCHECK(string_table_lock != NULL);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  // Decomposes the module, pours its samples into its basic-blocks and rolls
+  // them up to names if need be. This may be called on a worker thread, while
+  // the module data is only ever read.
+  virtual void Run() OVERRIDE {
+    LOG(INFO) << "Processing aggregate samples for module \""
+              << module_data_.module_path.value() << "\".";
+
+    // In basic-block, function and compiland aggregation mode we decompose
+    // the image to get compilands, functions and basic blocks.
+    // TODO(chrisha): We shouldn't need full decomposition for this.
+    if (!BuildEmptyHeatMap(module_key_, module_data_, string_table_,
+                           string_table_lock_, &heat_map_)) {
+      return;
+    }
+
+    // Populate the heat map by pouring the sample data into it.
+    orphaned_ = IncrementHeatMapFromModuleData(module_data_, &heat_map_,
+                                               &total_);
+
+    if (aggregation_level_ != kBasicBlock) {
+      LOG(INFO) << "Rolling up basic-block heat to \""
+                << kAggregationLevelNames[aggregation_level_] << "\" level.";
+      RollUpByName(aggregation_level_, heat_map_, &name_heat_map_);
+      // We can clear the heat map as it was only needed as an intermediate.
+      heat_map_.Clear();
+    }
+
+    succeeded_ = true;
+  }
+  // @}
+
+  // @name Accessors.
+  // @{
+  const base::FilePath& module_path() const {
+    return module_data_.module_path;
+  }
+  bool succeeded() const { return succeeded_; }
+  double total() const { return total_; }
+  double orphaned() const { return orphaned_; }
+  const HeatMap& heat_map() const { return heat_map_; }
+  const NameHeatMap& name_heat_map() const { return name_heat_map_; }
+  // @}
+
+ private:
+  AggregationLevel aggregation_level_;
+  const ModuleKey& module_key_;
+  const ModuleData& module_data_;
+  core::StringTable* string_table_;
+  base::Lock* string_table_lock_;
+  bool succeeded_;
+  double total_;
+  double orphaned_;
+  HeatMap heat_map_;
+  NameHeatMap name_heat_map_;
+
+  DISALLOW_COPY_AND_ASSIGN(ModuleGrinder);
+};
+
 SampleGrinder::SampleGrinder()
     : aggregation_level_(kBasicBlock),
+      grind_threads_(1),
       parser_(NULL),
       event_handler_errored_(false),
       clock_rate_(0.0) {
@@ -371,6 +554,17 @@ bool SampleGrinder::ParseCommandLine(const CommandLine* command_line) {
     }
   }
 
+  std::string grind_threads = command_line->GetSwitchValueASCII(
+      kGrindThreads);
+  if (!grind_threads.empty()) {
+    if (!base::StringToSizeT(grind_threads, &grind_threads_) ||
+        grind_threads_ < 1 || grind_threads_ > kMaxGrindThreads) {
+      LOG(ERROR) << "Invalid " << kGrindThreads << " value: " << grind_threads
+                 << ".";
+      return false;
+    }
+  }
+
   // Parse the image parameter, and initialize information about the image of
   // interest.
   image_path_ = command_line->GetSwitchValuePath(kImage);
@@ -395,7 +589,46 @@ void SampleGrinder::SetParser(Parser* parser) {
   parser_ = parser;
 }
 
+bool SampleGrinder::LoadData(const base::FilePath& path) {
+  // The heat is output once aggregated, which loses the per-bucket samples
+  // that further trace files would need to be merged into.
+  LOG(ERROR) << "Incremental grinding is not supported in this mode.";
+  return false;
+}
+
+bool SampleGrinder::Merge(GrinderInterface* other) {
+  DCHECK(other != NULL);
+  SampleGrinder* other_grinder = static_cast<SampleGrinder*>(other);
+  DCHECK_EQ(aggregation_level_, other_grinder->aggregation_level_);
+
+  if (other_grinder->event_handler_errored_)
+    event_handler_errored_ = true;
+
+  ModuleDataMap::iterator other_it = other_grinder->module_data_.begin();
+  for (; other_it != other_grinder->module_data_.end(); ++other_it) {
+    std::pair<ModuleDataMap::iterator, bool> result = module_data_.insert(
+        std::make_pair(other_it->first, ModuleData()));
+    if (result.second)
+      result.first->second.module_path = other_it->second.module_path;
+
+    if (!MergeModuleData(&other_it->second, &result.first->second))
+      return false;
+  }
+
+  StackCountMap::const_iterator stack_it =
+      other_grinder->stack_counts_.begin();
+  for (; stack_it != other_grinder->stack_counts_.end(); ++stack_it)
+    stack_counts_[stack_it->first] += stack_it->second;
+  stack_module_paths_.insert(other_grinder->stack_module_paths_.begin(),
+                             other_grinder->stack_module_paths_.end());
+
+  return true;
+}
+
 bool SampleGrinder::Grind() {
+  if (aggregation_level_ == kStack)
+    return GrindStacks();
+
   if (event_handler_errored_) {
     LOG(WARNING) << "Failed to handle all TraceSampleData records, results "
                  << "will be partial.";
@@ -413,28 +646,85 @@ bool SampleGrinder::Grind() {
     }
   }
 
-  // Process each module.
+  if (aggregation_level_ == kLine)
+    return GrindLines();
+
+  // Decompose and grind each module on its own, concurrently if requested.
+  // The modules share only the string table the names are interned in.
+  base::Lock string_table_lock;
+  ScopedVector<ModuleGrinder> module_grinders;
   ModuleDataMap::const_iterator mod_it = module_data_.begin();
   for (; mod_it != module_data_.end(); ++mod_it) {
-    LOG(INFO) << "Processing aggregate samples for module \""
-              << mod_it->second.module_path.value() << "\".";
+    module_grinders.push_back(new ModuleGrinder(aggregation_level_,
+                                                mod_it->first,
+                                                mod_it->second,
+                                                &string_table_,
+                                                &string_table_lock));
+  }
+
+  size_t num_workers = std::min(grind_threads_, module_grinders.size());
+  if (num_workers > 1) {
+    base::DelegateSimpleThreadPool pool("SampleGrinder",
+                                        static_cast<int>(num_workers));
+    pool.Start();
+    for (size_t i = 0; i < module_grinders.size(); ++i)
+      pool.AddWork(module_grinders[i]);
+    pool.JoinAll();
+  } else {
+    for (size_t i = 0; i < module_grinders.size(); ++i)
+      module_grinders[i]->Run();
+  }
 
-    // Build an empty heat map. How exactly we do this depends on the
-    // aggregation mode.
-    bool empty_heat_map_built = false;
-    if (aggregation_level_ == kLine) {
-      // In line aggregation mode we simply extract line info from the PDB.
-      empty_heat_map_built = BuildEmptyHeatMap(
-          mod_it->second.module_path, &line_info_, &heat_map_);
+  // Merge the results in module order, so that the outcome does not depend
+  // on the number of threads.
+  for (size_t i = 0; i < module_grinders.size(); ++i) {
+    ModuleGrinder* module_grinder = module_grinders[i];
+    const base::FilePath& module_path = module_grinder->module_path();
+    if (!module_grinder->succeeded()) {
+      LOG(ERROR) << "Unable to build empty heat map for module \""
+                 << module_path.value() << "\".";
+      return false;
+    }
+
+    if (module_grinder->orphaned() > 0) {
+      LOG(WARNING) << base::StringPrintf("%.2f%% (%.4f s) ",
+                                         module_grinder->orphaned() /
+                                             module_grinder->total(),
+                                         module_grinder->orphaned())
+                   << "samples were orphaned for module \""
+                   << module_path.value() << "\".";
+    }
+
+    if (aggregation_level_ == kBasicBlock) {
+      const HeatMap& heat_map = module_grinder->heat_map();
+      HeatMap::const_iterator it = heat_map.begin();
+      for (; it != heat_map.end(); ++it) {
+        if (!heat_map_.Insert(it->first, it->second)) {
+          LOG(ERROR) << "Failed to insert the heat of module \""
+                     << module_path.value() << "\".";
+          return false;
+        }
+      }
     } else {
-      // In basic-block, function and compiland aggregation mode we decompose
-      // the image to get compilands, functions and basic blocks.
-      // TODO(chrisha): We shouldn't need full decomposition for this.
-      empty_heat_map_built = BuildEmptyHeatMap(
-          mod_it->first, mod_it->second, &string_table_, &heat_map_);
+      const NameHeatMap& name_heat_map = module_grinder->name_heat_map();
+      NameHeatMap::const_iterator it = name_heat_map.begin();
+      for (; it != name_heat_map.end(); ++it)
+        name_heat_map_[it->first] += it->second;
     }
+  }
 
-    if (!empty_heat_map_built) {
+  return true;
+}
+
+bool SampleGrinder::GrindLines() {
+  ModuleDataMap::const_iterator mod_it = module_data_.begin();
+  for (; mod_it != module_data_.end(); ++mod_it) {
+    LOG(INFO) << "Processing aggregate samples for module \""
+              << mod_it->second.module_path.value() << "\".";
+
+    // In line aggregation mode we simply extract line info from the PDB.
+    if (!BuildEmptyHeatMap(mod_it->second.module_path, &line_info_,
+                           &heat_map_)) {
       LOG(ERROR) << "Unable to build empty heat map for module \""
                   << mod_it->second.module_path.value() << "\".";
       return false;
@@ -453,21 +743,13 @@ bool SampleGrinder::Grind() {
                     << mod_it->second.module_path.value() << "\".";
     }
 
-    if (aggregation_level_ == kFunction || aggregation_level_ == kCompiland) {
-      LOG(INFO) << "Rolling up basic-block heat to \""
-                << kAggregationLevelNames[aggregation_level_] << "\" level.";
-      RollUpByName(aggregation_level_, heat_map_, &name_heat_map_);
-      // We can clear the heat map as it was only needed as an intermediate.
-      heat_map_.Clear();
-    } else if (aggregation_level_ == kLine) {
-      LOG(INFO) << "Rolling up basic-block heat to lines.";
-      if (!RollUpToLines(heat_map_, &line_info_)) {
-        LOG(ERROR) << "Failed to roll-up heat to lines.";
-        return false;
-      }
-      // We can clear the heat map as it was only needed as an intermediate.
-      heat_map_.Clear();
+    LOG(INFO) << "Rolling up basic-block heat to lines.";
+    if (!RollUpToLines(heat_map_, &line_info_)) {
+      LOG(ERROR) << "Failed to roll-up heat to lines.";
+      return false;
     }
+    // We can clear the heat map as it was only needed as an intermediate.
+    heat_map_.Clear();
   }
 
   return true;
@@ -484,6 +766,8 @@ bool SampleGrinder::OutputData(FILE* file) {
     // If we've aggregated by function or compiland then output the data in
     // the NameHeatMap.
     success = OutputNameHeatMap(aggregation_level_, name_heat_map_, file);
+  } else if (aggregation_level_ == kStack) {
+    success = OutputFoldedStacks(folded_stacks_, file);
   } else {
     // Otherwise, we're aggregating to lines and we output cache-grind formatted
     // line-info data.
@@ -561,6 +845,121 @@ void SampleGrinder::OnSampleData(base::Time Time,
   return;
 }
 
+void SampleGrinder::OnSampleStacks(base::Time time,
+                                   DWORD process_id,
+                                   const TraceSampleStacks* data) {
+  DCHECK(data != NULL);
+
+  const ModuleAddr* frames =
+      reinterpret_cast<const ModuleAddr*>(data->stacks + data->num_stacks);
+  StackIdMap& stacks = process_stacks_[process_id];
+  for (size_t i = 0; i < data->num_stacks; ++i) {
+    const TraceSampleStack& sample_stack = data->stacks[i];
+
+    // The frames of a stack are only written the first time it's seen.
+    if (sample_stack.num_frames != 0) {
+      Stack& stack = stacks[sample_stack.stack_id];
+      stack.clear();
+      for (size_t j = 0; j < sample_stack.num_frames; ++j, ++frames)
+        stack.push_back(GetStackFrame(process_id, *frames));
+    }
+
+    StackIdMap::const_iterator stack_it = stacks.find(sample_stack.stack_id);
+    if (stack_it == stacks.end()) {
+      LOG(ERROR) << "Unknown stack ID " << sample_stack.stack_id
+                 << " in TraceSampleStacks record.";
+      event_handler_errored_ = true;
+      continue;
+    }
+    const Stack& stack = stack_it->second;
+
+    // Filter based on the image of interest, if provided. Only the stacks
+    // that go through it are kept.
+    if (!image_path_.empty()) {
+      bool image_seen = false;
+      for (size_t j = 0; j < stack.size() && !image_seen; ++j)
+        image_seen = ModuleKeyMatches(stack[j].module_key, image_signature_);
+      if (!image_seen)
+        continue;
+    }
+
+    stack_counts_[stack] += sample_stack.count;
+  }
+}
+
+SampleGrinder::StackFrame SampleGrinder::GetStackFrame(DWORD process_id,
+                                                       ModuleAddr address) {
+  uint32 absolute_address = reinterpret_cast<uint32>(address);
+  StackFrame frame = {};
+  frame.address = absolute_address;
+
+  const ModuleInformation* module_info = parser_->GetModuleInformation(
+      process_id, AbsoluteAddress64(absolute_address));
+  if (module_info == NULL)
+    return frame;
+
+  frame.module_key.module_size = module_info->module_size;
+  frame.module_key.module_checksum = module_info->image_checksum;
+  frame.module_key.module_time_date_stamp = module_info->time_date_stamp;
+  frame.address =
+      absolute_address - static_cast<uint32>(module_info->base_address);
+  stack_module_paths_.insert(std::make_pair(
+      frame.module_key, base::FilePath(module_info->image_file_name)));
+
+  return frame;
+}
+
+bool SampleGrinder::GrindStacks() {
+  if (event_handler_errored_) {
+    LOG(WARNING) << "Failed to handle all TraceSampleStacks records, results "
+                 << "will be partial.";
+  }
+
+  if (stack_counts_.empty()) {
+    LOG(ERROR) << "No sampled stacks encountered.";
+    return false;
+  }
+
+  // Get the functions of the modules the frames belong to, restricting
+  // ourselves to the image of interest if one was provided.
+  ModuleHeatMaps heat_maps;
+  base::Lock string_table_lock;
+  ModulePathMap::const_iterator mod_it = stack_module_paths_.begin();
+  for (; mod_it != stack_module_paths_.end(); ++mod_it) {
+    if (!image_path_.empty() &&
+        !ModuleKeyMatches(mod_it->first, image_signature_)) {
+      continue;
+    }
+
+    ModuleData module_data;
+    module_data.module_path = mod_it->second;
+    HeatMap& heat_map = heat_maps[mod_it->first];
+    if (!BuildEmptyHeatMap(mod_it->first, module_data, &string_table_,
+                           &string_table_lock, &heat_map)) {
+      LOG(WARNING) << "Unable to get the functions of module \""
+                   << mod_it->second.value() << "\", its frames are "
+                   << "named by offset.";
+      heat_maps.erase(mod_it->first);
+    }
+  }
+
+  // Fold each stack, outermost frame first.
+  StackCountMap::const_iterator stack_it = stack_counts_.begin();
+  for (; stack_it != stack_counts_.end(); ++stack_it) {
+    const Stack& stack = stack_it->first;
+    std::string folded_stack;
+    for (size_t i = stack.size(); i > 0; --i) {
+      if (!folded_stack.empty())
+        folded_stack.append(";");
+      folded_stack.append(GetStackFrameName(
+          stack[i - 1], i > 1, stack_module_paths_, heat_maps));
+    }
+    folded_stacks_[folded_stack] += stack_it->second;
+  }
+
+  return true;
+}
+
 SampleGrinder::ModuleData* SampleGrinder::GetModuleData(
     const base::FilePath& module_path,
     const TraceSampleData* sample_data) {
@@ -602,26 +1001,51 @@ void SampleGrinder::UpsampleModuleData(
   if (module_data->bucket_size <= sample_data->bucket_size)
     return;
 
-  // Grow the buckets in place, and then fill in the scaled values tail first.
-  std::vector<double>& buckets = module_data->buckets;
-  size_t old_size = buckets.size();
-  size_t factor = module_data->bucket_size / sample_data->bucket_size;
-  size_t new_size = old_size * factor;
-  buckets.resize(new_size);
-  for (size_t i = old_size, j = new_size; i > 0; ) {
-    --i;
-    double new_value = buckets[i] / factor;
+  UpsampleBuckets(sample_data->bucket_size, module_data);
 
-    for (size_t k = 0; k < factor; ++k) {
-      --j;
-      buckets[j] = new_value;
-    }
+  return;
+}
+
+bool SampleGrinder::MergeModuleData(
+    SampleGrinder::ModuleData* other_module_data,
+    SampleGrinder::ModuleData* module_data) {
+  DCHECK(other_module_data != NULL);
+  DCHECK(module_data != NULL);
+
+  // Special cases: either of the module data may not have been initialized.
+  if (other_module_data->bucket_size == 0)
+    return true;
+  if (module_data->bucket_size == 0) {
+    module_data->bucket_size = other_module_data->bucket_size;
+    module_data->bucket_start = other_module_data->bucket_start;
+    module_data->buckets.swap(other_module_data->buckets);
+    return true;
   }
 
-  // Update the bucket size.
-  module_data->bucket_size = sample_data->bucket_size;
+  // The bucket starts need to be consistent.
+  if (other_module_data->bucket_start != module_data->bucket_start) {
+    LOG(ERROR) << "Module data for \"" << module_data->module_path.value()
+               << "\" has an inconsistent bucket start.";
+    return false;
+  }
 
-  return;
+  // Bring both to the finer of the two resolutions.
+  if (other_module_data->bucket_size > module_data->bucket_size)
+    UpsampleBuckets(module_data->bucket_size, other_module_data);
+  else if (other_module_data->bucket_size < module_data->bucket_size)
+    UpsampleBuckets(other_module_data->bucket_size, module_data);
+  DCHECK_EQ(module_data->bucket_size, other_module_data->bucket_size);
+
+  // Upsampling may leave the bucket counts differing by less than one of the
+  // coarser buckets, as is tolerated by IncrementModuleData.
+  const std::vector<double>& other_buckets = other_module_data->buckets;
+  std::vector<double>& buckets = module_data->buckets;
+  if (buckets.size() < other_buckets.size())
+    buckets.resize(other_buckets.size());
+  for (size_t i = 0; i < other_buckets.size(); ++i)
+    buckets[i] += other_buckets[i];
+
+  return true;
 }
 
 // Increments the module data with the given sample data. Returns false and
@@ -694,65 +1118,60 @@ double SampleGrinder::IncrementHeatMapFromModuleData(
   double orphaned_samples = 0.0;
   double temp_total_samples = 0.0;
 
-  // We walk through the sample buckets, and for each one we find the range of
-  // heat map entries that intersect with it. We then divide up the heat to
-  // each of these ranges in proportion to the size of their intersection.
+  // We sweep the sample buckets and the heat map ranges together, both being
+  // sorted by address. Each bucket's samples are divided up among the ranges
+  // that intersect it, in proportion to the size of their intersection.
+  std::vector<size_t> intersections;
   core::RelativeAddress rva_bucket(module_data.bucket_start);
   HeatMap::iterator it = heat_map->begin();
-  size_t i = 0;
-  for (; i < module_data.buckets.size(); ++i) {
+  for (size_t i = 0; i < module_data.buckets.size();
+       ++i, rva_bucket += module_data.bucket_size) {
+    double samples = module_data.buckets[i];
+    temp_total_samples += samples;
+
+    // Empty buckets, which dominate at fine bucket sizes, have nothing to
+    // distribute.
+    if (samples == 0)
+      continue;
+
     // Advance the current heat map range as long as it's strictly to the left
     // of the current bucket.
     while (it != heat_map->end() && it->first.end() <= rva_bucket)
       ++it;
-    if (it == heat_map->end())
-      break;
 
     // If the current heat map range is strictly to the right of the current
-    // bucket then those samples have nowhere to be distributed.
-    if (rva_bucket + module_data.bucket_size <= it->first.start()) {
-      // Tally them up as orphaned samples.
-      orphaned_samples += module_data.buckets[i];
-    } else {
-      // Otherwise we heat map ranges that overlap the current bucket.
-
-      // Advance the current heat map range until we're strictly to the right
-      // of the current bucket.
-      HeatMap::iterator it_end = it;
-      ++it_end;
-      while (it_end != heat_map->end() &&
-          it_end->first.start() < rva_bucket + module_data.bucket_size) {
-        ++it_end;
-      }
-
-      // Find the total size of the intersections, to be used as a scaling
-      // value for distributing the samples. This is done so that *all* of the
-      // samples are distributed, as the bucket may span space that is not
-      // covered by any heat map ranges.
-      size_t total_intersection = 0;
-      for (HeatMap::iterator it2 = it; it2 != it_end; ++it2) {
-        total_intersection += IntersectionSize(it2->first,
-            rva_bucket, module_data.bucket_size);
-      }
+    // bucket, or there is none left, then those samples have nowhere to be
+    // distributed. Tally them up as orphaned samples.
+    core::RelativeAddress bucket_end = rva_bucket + module_data.bucket_size;
+    if (it == heat_map->end() || bucket_end <= it->first.start()) {
+      orphaned_samples += samples;
+      continue;
+    }
 
-      // Now distribute the samples to the various ranges.
-      for (HeatMap::iterator it2 = it; it2 != it_end; ++it2) {
-        size_t intersection = IntersectionSize(it2->first,
-            rva_bucket, module_data.bucket_size);
-        it2->second.heat += intersection * module_data.buckets[i] /
-            total_intersection;
-      }
+    // A bucket that lies within a single range gives it all of its samples.
+    if (it->first.start() <= rva_bucket && bucket_end <= it->first.end()) {
+      it->second.heat += samples;
+      continue;
     }
 
-    // Advance past the current bucket.
-    temp_total_samples += module_data.buckets[i];
-    rva_bucket += module_data.bucket_size;
-  }
+    // Otherwise find the intersections of the ranges that overlap the bucket.
+    // Their total is used as a scaling value for distributing the samples.
+    // This is done so that *all* of the samples are distributed, as the
+    // bucket may span space that is not covered by any heat map ranges.
+    intersections.clear();
+    size_t total_intersection = 0;
+    HeatMap::iterator it2 = it;
+    for (; it2 != heat_map->end() && it2->first.start() < bucket_end; ++it2) {
+      size_t intersection = IntersectionSize(it2->first, rva_bucket,
+                                             module_data.bucket_size);
+      intersections.push_back(intersection);
+      total_intersection += intersection;
+    }
 
-  // Pick up any trailing orphaned buckets.
-  for (; i < module_data.buckets.size(); ++i) {
-    orphaned_samples += module_data.buckets[i];
-    temp_total_samples += module_data.buckets[i];
+    // Now distribute the samples to the various ranges.
+    it2 = it;
+    for (size_t j = 0; j < intersections.size(); ++j, ++it2)
+      it2->second.heat += intersections[j] * samples / total_intersection;
   }
 
   if (total_samples != NULL)
@@ -767,14 +1186,19 @@ void SampleGrinder::RollUpByName(AggregationLevel aggregation_level,
   DCHECK(aggregation_level == kFunction || aggregation_level == kCompiland);
   DCHECK(name_heat_map != NULL);
 
+  // The basic-blocks of a function, and the functions of a compiland, are
+  // mostly contiguous. The entry of the previous name is reused rather than
+  // looked up again.
+  NameHeatMap::iterator nhm_it = name_heat_map->end();
   HeatMap::const_iterator it = heat_map.begin();
   for (; it != heat_map.end(); ++it) {
     const std::string* name = it->second.function;
     if (aggregation_level == kCompiland)
       name = it->second.compiland;
 
-    NameHeatMap::iterator nhm_it = name_heat_map->insert(
-        std::make_pair(name, 0.0)).first;
+    if (nhm_it == name_heat_map->end() || nhm_it->first != name) {
+      nhm_it = name_heat_map->insert(std::make_pair(name, 0.0)).first;
+    }
     nhm_it->second += it->second.heat;
   }
 }
@@ -794,5 +1218,13 @@ bool SampleGrinder::ModuleKey::operator<(
   return false;
 }
 
+bool SampleGrinder::StackFrame::operator<(const StackFrame& rhs) const {
+  if (module_key < rhs.module_key)
+    return true;
+  if (rhs.module_key < module_key)
+    return false;
+  return address < rhs.address;
+}
+
 }  // namespace grinders
 }  // namespace grinder
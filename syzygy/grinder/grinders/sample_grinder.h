@@ -15,7 +15,10 @@
 // Declares the sample grinder, which processes trace files containing
 // TraceSampleData records. It can aggregate to a variety of targets
 // (basic blocks, functions, compilands, lines), and output to a variety of
-// formats (CSV, KCacheGrind).
+// formats (CSV, KCacheGrind). It also processes the TraceSampleStacks records
+// of the stack sampling mode of the sampler, which it aggregates to call
+// stacks of function names, output in the folded format of flame graph
+// tools.
 
 #ifndef SYZYGY_GRINDER_GRINDERS_SAMPLE_GRINDER_H_
 #define SYZYGY_GRINDER_GRINDERS_SAMPLE_GRINDER_H_
@@ -39,6 +42,7 @@ class SampleGrinder : public GrinderInterface {
     kFunction,
     kCompiland,
     kLine,
+    kStack,
     kAggregationLevelMax,  // Must be last.
   };
 
@@ -53,6 +57,8 @@ class SampleGrinder : public GrinderInterface {
   // @{
   virtual bool ParseCommandLine(const CommandLine* command_line) OVERRIDE;
   virtual void SetParser(Parser* parser) OVERRIDE;
+  virtual bool LoadData(const base::FilePath& path) OVERRIDE;
+  virtual bool Merge(GrinderInterface* other) OVERRIDE;
   virtual bool Grind() OVERRIDE;
   virtual bool OutputData(FILE* file) OVERRIDE;
   // @}
@@ -68,18 +74,27 @@ class SampleGrinder : public GrinderInterface {
   virtual void OnSampleData(base::Time Time,
                             DWORD process_id,
                             const TraceSampleData* data) OVERRIDE;
+  // Override of the OnSampleStacks callback.
+  virtual void OnSampleStacks(base::Time time,
+                              DWORD process_id,
+                              const TraceSampleStacks* data) OVERRIDE;
   // @}
 
   // @name Parameter names.
   // @{
   static const char kAggregationLevel[];
+  static const char kGrindThreads[];
   static const char kImage[];
   // @}
 
+  // The maximum number of modules to grind concurrently.
+  static const size_t kMaxGrindThreads;
+
   // Forward declarations. These are public so that they are accessible by
   // anonymous helper functions.
   struct ModuleKey;
   struct ModuleData;
+  struct StackFrame;
 
   // Some type definitions. There are public so that they are accessible by
   // anonymous helper functions.
@@ -100,7 +115,17 @@ class SampleGrinder : public GrinderInterface {
   // named objects (compilands or functions).
   typedef std::map<const std::string*, double> NameHeatMap;
 
+  // A sampled call stack, innermost frame first.
+  typedef std::vector<StackFrame> Stack;
+
+  // The paths of the modules that the frames of sampled stacks belong to.
+  typedef std::map<ModuleKey, base::FilePath> ModulePathMap;
+
  protected:
+  // Decomposes a module and grinds its samples to heat. Modules are ground
+  // concurrently, each by one of these. Defined in the implementation.
+  class ModuleGrinder;
+
   // Finds or creates the sample data associated with the given module.
   ModuleData* GetModuleData(
       const base::FilePath& module_path,
@@ -116,6 +141,16 @@ class SampleGrinder : public GrinderInterface {
       const TraceSampleData* sample_data,
       SampleGrinder::ModuleData* module_data);
 
+  // Merges the samples of @p other_module_data into @p module_data, bringing
+  // both to the finer of their two resolutions.
+  // @param other_module_data The module data to be merged. This may be
+  //     upsampled or emptied in the process.
+  // @param module_data The module data to be incremented.
+  // @returns True on success, false otherwise.
+  static bool MergeModuleData(
+      SampleGrinder::ModuleData* other_module_data,
+      SampleGrinder::ModuleData* module_data);
+
   // Updates the @p module_data with the samples from @p sample_data. The
   // @p module_data must already be at sufficient resolution to accept the
   // data in @p sample_data. This can fail if the @p sample_data and the
@@ -131,7 +166,8 @@ class SampleGrinder : public GrinderInterface {
 
   // Given a populated @p heat_map and aggregate @p module_data, estimates heat
   // for each range in the @p heat_map. The values represent an estimate of
-  // amount of time spent in the range, in seconds.
+  // amount of time spent in the range, in seconds. This is a single sweep of
+  // the buckets against the address-sorted ranges.
   // @param module_data Aggregate module data.
   // @param heat A pre-populated address space representing the basic blocks of
   //     the module in question.
@@ -154,6 +190,23 @@ class SampleGrinder : public GrinderInterface {
                            const HeatMap& heat_map,
                            NameHeatMap* name_heat_map);
 
+  // Converts the address of a frame sampled in a process to a StackFrame,
+  // and notes the path of the module it belongs to.
+  // @param process_id The ID of the process the frame was sampled in.
+  // @param address The address of the frame.
+  // @returns the frame.
+  StackFrame GetStackFrame(DWORD process_id, ModuleAddr address);
+
+  // Folds the sampled stacks to lists of function names. This is the 'stack'
+  // aggregation mode of Grind().
+  // @returns true on success, false otherwise.
+  bool GrindStacks();
+
+  // Rolls the samples of each module up to source lines. This is the 'line'
+  // aggregation mode of Grind().
+  // @returns true on success, false otherwise.
+  bool GrindLines();
+
   // The aggregation level to be used in processing samples.
   AggregationLevel aggregation_level_;
 
@@ -163,6 +216,10 @@ class SampleGrinder : public GrinderInterface {
   pe::PEFile image_;
   pe::PEFile::Signature image_signature_;
 
+  // The number of modules to grind concurrently in the 'function' and
+  // 'compiland' aggregation modes.
+  size_t grind_threads_;
+
   // Points to the parser that is feeding us events. Used to get module
   // information.
   Parser* parser_;
@@ -189,6 +246,23 @@ class SampleGrinder : public GrinderInterface {
   // Used only in 'line' aggregation mode. Populated by Grind().
   LineInfo line_info_;
 
+  // The frames of the stacks sampled in each process, by stack ID. The frames
+  // of a stack are only written in the first record it appears in.
+  typedef std::map<uint32, Stack> StackIdMap;
+  typedef std::map<DWORD, StackIdMap> ProcessStackMap;
+  ProcessStackMap process_stacks_;
+
+  // The number of samples of each distinct stack, across processes.
+  typedef std::map<Stack, uint64> StackCountMap;
+  StackCountMap stack_counts_;
+  ModulePathMap stack_module_paths_;
+
+  // Used only in 'stack' aggregation mode. Populated by Grind(). Maps stacks
+  // of function names, outermost first and separated by semicolons, to their
+  // number of samples.
+  typedef std::map<std::string, uint64> FoldedStackMap;
+  FoldedStackMap folded_stacks_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(SampleGrinder);
 };
@@ -210,6 +284,17 @@ struct SampleGrinder::ModuleData {
   std::vector<double> buckets;
 };
 
+struct SampleGrinder::StackFrame {
+  // The module the frame belongs to. This is all zeros for the frames outside
+  // of any known module.
+  ModuleKey module_key;
+  // The address of the frame, relative to its module. This is an absolute
+  // address for the frames outside of any known module.
+  uint32 address;
+
+  bool operator<(const StackFrame& rhs) const;
+};
+
 }  // namespace grinders
 }  // namespace grinder
 
@@ -44,11 +44,13 @@ class TestSampleGrinder : public SampleGrinder {
 
   // Members.
   using SampleGrinder::aggregation_level_;
+  using SampleGrinder::grind_threads_;
   using SampleGrinder::image_path_;
   using SampleGrinder::parser_;
   using SampleGrinder::heat_map_;
   using SampleGrinder::name_heat_map_;
   using SampleGrinder::line_info_;
+  using SampleGrinder::folded_stacks_;
 };
 
 class SampleGrinderTest : public testing::PELibUnitTest {
@@ -490,6 +492,15 @@ TEST_F(SampleGrinderTest, ParseCommandLineAggregationLevel) {
     EXPECT_EQ(SampleGrinder::kLine, g.aggregation_level_);
   }
 
+  cmd_line_.Init(0, NULL);
+  cmd_line_.AppendSwitchASCII(SampleGrinder::kAggregationLevel, "stack");
+  {
+    TestSampleGrinder g;
+    EXPECT_TRUE(g.ParseCommandLine(&cmd_line_));
+    EXPECT_TRUE(g.image_path_.empty());
+    EXPECT_EQ(SampleGrinder::kStack, g.aggregation_level_);
+  }
+
   cmd_line_.Init(0, NULL);
   cmd_line_.AppendSwitchASCII(SampleGrinder::kAggregationLevel, "foobar");
   {
@@ -548,6 +559,32 @@ TEST_F(SampleGrinderTest, ParseCommandLineAggregationLevel) {
   }
 }
 
+TEST_F(SampleGrinderTest, ParseCommandLineGrindThreads) {
+  cmd_line_.AppendSwitchASCII(SampleGrinder::kAggregationLevel, "function");
+  {
+    TestSampleGrinder g;
+    EXPECT_TRUE(g.ParseCommandLine(&cmd_line_));
+    EXPECT_EQ(1u, g.grind_threads_);
+  }
+
+  cmd_line_.AppendSwitchASCII(SampleGrinder::kGrindThreads, "4");
+  {
+    TestSampleGrinder g;
+    EXPECT_TRUE(g.ParseCommandLine(&cmd_line_));
+    EXPECT_EQ(4u, g.grind_threads_);
+  }
+
+  const char* kInvalidValues[] = { "0", "foo", "65" };
+  for (size_t i = 0; i < arraysize(kInvalidValues); ++i) {
+    cmd_line_.Init(0, NULL);
+    cmd_line_.AppendSwitchASCII(SampleGrinder::kAggregationLevel, "function");
+    cmd_line_.AppendSwitchASCII(SampleGrinder::kGrindThreads,
+                                kInvalidValues[i]);
+    TestSampleGrinder g;
+    EXPECT_FALSE(g.ParseCommandLine(&cmd_line_));
+  }
+}
+
 TEST_F(SampleGrinderTest, SetParserSucceeds) {
   TestSampleGrinder g;
   EXPECT_TRUE(g.parser_ == NULL);
@@ -571,6 +608,11 @@ TEST_F(SampleGrinderTest, GrindFunctionNoImageSpecified) {
   ASSERT_NO_FATAL_FAILURE(GrindSucceeds(SampleGrinder::kFunction, false));
 }
 
+TEST_F(SampleGrinderTest, GrindFunctionConcurrently) {
+  cmd_line_.AppendSwitchASCII(SampleGrinder::kGrindThreads, "2");
+  ASSERT_NO_FATAL_FAILURE(GrindSucceeds(SampleGrinder::kFunction, false));
+}
+
 TEST_F(SampleGrinderTest, GrindCompiland) {
   TestSampleGrinder g;
   ASSERT_NO_FATAL_FAILURE(GrindSucceeds(SampleGrinder::kCompiland, true));
@@ -591,5 +633,39 @@ TEST_F(SampleGrinderTest, GrindLineNoImageSpecified) {
   ASSERT_NO_FATAL_FAILURE(GrindSucceeds(SampleGrinder::kLine, false));
 }
 
+TEST_F(SampleGrinderTest, GrindStack) {
+  TestSampleGrinder g;
+  cmd_line_.AppendSwitchPath(SampleGrinder::kImage, test_dll_path_);
+  cmd_line_.AppendSwitchASCII(
+      SampleGrinder::kAggregationLevel,
+      SampleGrinder::kAggregationLevelNames[SampleGrinder::kStack]);
+  ASSERT_TRUE(g.ParseCommandLine(&cmd_line_));
+
+  ASSERT_NO_FATAL_FAILURE(WriteDummySampleData());
+  ASSERT_NO_FATAL_FAILURE(InitParser(&g));
+  g.SetParser(&parser_);
+  ASSERT_TRUE(parser_.Consume());
+
+  ASSERT_TRUE(g.Grind());
+  EXPECT_TRUE(g.heat_map_.empty());
+  EXPECT_TRUE(g.name_heat_map_.empty());
+
+  // The dummy stack goes from outside of any module into 'LabelTestFunc'.
+  ASSERT_EQ(1u, g.folded_stacks_.size());
+  EXPECT_EQ("0x00401000;_LabelTestFunc", g.folded_stacks_.begin()->first);
+  EXPECT_EQ(100u, g.folded_stacks_.begin()->second);
+
+  // Produce the output.
+  base::FilePath output_path = temp_dir_.Append(L"output.txt");
+  file_util::ScopedFILE output_file(file_util::OpenFile(output_path, "wb"));
+  ASSERT_TRUE(output_file.get() != NULL);
+  ASSERT_TRUE(g.OutputData(output_file.get()));
+  output_file.reset();
+
+  std::string output;
+  ASSERT_TRUE(file_util::ReadFileToString(output_path, &output));
+  EXPECT_EQ("0x00401000;_LabelTestFunc 100\n", output);
+}
+
 }  // namespace grinders
 }  // namespace grinder
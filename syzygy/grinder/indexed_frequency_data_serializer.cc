@@ -14,12 +14,18 @@
 
 #include "syzygy/grinder/indexed_frequency_data_serializer.h"
 
+#include <fcntl.h>
+#include <io.h>
+
 #include <string>
 #include <utility>
 
 #include "base/stringprintf.h"
 #include "base/files/file_path.h"
 #include "base/json/json_reader.h"
+#include "base/win/scoped_handle.h"
+#include "sawbuck/common/com_utils.h"
+#include "syzygy/common/align.h"
 #include "syzygy/common/indexed_frequency_data.h"
 #include "syzygy/core/json_file_writer.h"
 #include "syzygy/pdb/pdb_reader.h"
@@ -48,6 +54,328 @@ const char kNumColumnsKey[] = "num_columns";
 const char kDataTypeKey[] = "data_type";
 const char kFrequencySizeKey[] = "frequency_size";
 
+// The magic value identifying the binary format, 'SZFQ' in little-endian
+// order, and its version.
+const uint32 kBinaryMagic = 0x51465A53;
+const uint32 kBinaryVersion = 1;
+
+// The alignments of the paths and of the module records of the binary format.
+const size_t kBinaryPathAlignment = 4;
+const size_t kBinaryRecordAlignment = 8;
+
+// The headers of the binary format. See indexed_frequency_data_serializer.h
+// for a description of the layout.
+struct BinaryFileHeader {
+  uint32 magic;
+  uint32 version;
+  uint32 num_modules;
+  uint32 reserved;
+};
+COMPILE_ASSERT(sizeof(BinaryFileHeader) == 16, invalid_binary_file_header);
+
+struct BinaryModuleHeader {
+  uint64 base_address;
+  uint32 module_size;
+  uint32 image_checksum;
+  uint32 time_date_stamp;
+  uint32 num_entries;
+  uint32 num_columns;
+  uint32 data_type;
+  uint32 frequency_size;
+  uint32 path_length;
+  uint32 num_rows;
+  uint32 num_data_columns;
+};
+COMPILE_ASSERT(sizeof(BinaryModuleHeader) == 48,
+               invalid_binary_module_header);
+
+// A read-only view of a whole file.
+class ScopedFileView {
+ public:
+  ScopedFileView() : data_(NULL), size_(0) {
+  }
+
+  ~ScopedFileView() {
+    if (data_ != NULL && !::UnmapViewOfFile(data_)) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to unmap view: " << com::LogWe(error) << ".";
+    }
+  }
+
+  // Maps the file at @p path.
+  // @returns true on success, false otherwise.
+  bool Init(const base::FilePath& path) {
+    DCHECK(data_ == NULL);
+
+    base::win::ScopedHandle file(::CreateFile(
+        path.value().c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+    if (!file.IsValid()) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Unable to open '" << path.value() << "': "
+                 << com::LogWe(error) << ".";
+      return false;
+    }
+
+    LARGE_INTEGER file_size = {};
+    if (!::GetFileSizeEx(file.Get(), &file_size)) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Unable to get the size of '" << path.value() << "': "
+                 << com::LogWe(error) << ".";
+      return false;
+    }
+
+    // It's not possible to map an empty file, but neither is it a valid one.
+    if (file_size.QuadPart < static_cast<LONGLONG>(sizeof(BinaryFileHeader)) ||
+        file_size.HighPart != 0) {
+      LOG(ERROR) << "Invalid size for '" << path.value() << "'.";
+      return false;
+    }
+
+    base::win::ScopedHandle mapping(::CreateFileMapping(
+        file.Get(), NULL, PAGE_READONLY, 0, 0, NULL));
+    if (!mapping.IsValid()) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Unable to map '" << path.value() << "': "
+                 << com::LogWe(error) << ".";
+      return false;
+    }
+
+    // The view keeps the mapping alive once the handles are closed.
+    data_ = reinterpret_cast<const uint8*>(
+        ::MapViewOfFile(mapping.Get(), FILE_MAP_READ, 0, 0, 0));
+    if (data_ == NULL) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Unable to map a view of '" << path.value() << "': "
+                 << com::LogWe(error) << ".";
+      return false;
+    }
+    size_ = file_size.LowPart;
+
+    return true;
+  }
+
+  const uint8* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const uint8* data_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedFileView);
+};
+
+// Gets a pointer to the next @p length bytes of a binary buffer, advancing
+// @p offset past them.
+// @returns true on success, false if they extend past the end of the buffer.
+bool ReadBinary(const uint8* data,
+                size_t data_size,
+                size_t length,
+                size_t* offset,
+                const void** range) {
+  DCHECK(offset != NULL);
+  DCHECK(range != NULL);
+
+  if (*offset > data_size || data_size - *offset < length) {
+    LOG(ERROR) << "Unexpected end of binary frequency data.";
+    return false;
+  }
+
+  *range = data + *offset;
+  *offset += length;
+  return true;
+}
+
+// Writes zeros to @p file up to the next multiple of @p alignment.
+bool WriteBinaryPadding(size_t alignment, size_t* offset, FILE* file) {
+  DCHECK(offset != NULL);
+  DCHECK(file != NULL);
+
+  static const uint8 kZeros[kBinaryRecordAlignment] = {};
+  size_t padding = common::AlignUp(*offset, alignment) - *offset;
+  DCHECK_GE(sizeof(kZeros), padding);
+  if (::fwrite(kZeros, 1, padding, file) != padding)
+    return false;
+  *offset += padding;
+  return true;
+}
+
+// Writes @p length bytes to @p file, keeping track of the @p offset at which
+// they end.
+bool WriteBinary(const void* data, size_t length, size_t* offset, FILE* file) {
+  DCHECK(offset != NULL);
+  DCHECK(file != NULL);
+
+  if (length != 0 && ::fwrite(data, 1, length, file) != length)
+    return false;
+  *offset += length;
+  return true;
+}
+
+bool OutputBinaryFrequencyData(
+    const ModuleInformation& module_information,
+    const IndexedFrequencyInformation& frequency_info,
+    size_t* offset,
+    FILE* file) {
+  DCHECK(offset != NULL);
+  DCHECK(file != NULL);
+  DCHECK(common::IsAligned(*offset, kBinaryRecordAlignment));
+
+  // Lay out the frequencies in columns, leaving out the basic blocks whose
+  // frequencies are all zero. The map is sorted by relative address, then by
+  // column.
+  const IndexedFrequencyMap& frequencies = frequency_info.frequency_map;
+  std::vector<uint32> addresses;
+  std::vector<std::vector<EntryCountType> > columns;
+  IndexedFrequencyMap::const_iterator it = frequencies.begin();
+  for (; it != frequencies.end(); ++it) {
+    if (it->second == 0)
+      continue;
+
+    uint32 address = it->first.first.value();
+    size_t column = it->first.second;
+    if (addresses.empty() || addresses.back() != address)
+      addresses.push_back(address);
+    if (columns.size() <= column)
+      columns.resize(column + 1);
+    columns[column].resize(addresses.size(), 0);
+    columns[column].back() = it->second;
+  }
+  for (size_t column = 0; column < columns.size(); ++column)
+    columns[column].resize(addresses.size(), 0);
+
+  const std::wstring& path = module_information.image_file_name;
+  BinaryModuleHeader header = {};
+  header.base_address = module_information.base_address;
+  header.module_size = module_information.module_size;
+  header.image_checksum = module_information.image_checksum;
+  header.time_date_stamp = module_information.time_date_stamp;
+  header.num_entries = frequency_info.num_entries;
+  header.num_columns = frequency_info.num_columns;
+  header.data_type = frequency_info.data_type;
+  header.frequency_size = frequency_info.frequency_size;
+  header.path_length = path.size();
+  header.num_rows = addresses.size();
+  header.num_data_columns = columns.size();
+
+  if (!WriteBinary(&header, sizeof(header), offset, file) ||
+      !WriteBinary(path.c_str(), path.size() * sizeof(path[0]), offset,
+                   file) ||
+      !WriteBinaryPadding(kBinaryPathAlignment, offset, file) ||
+      !WriteBinary(addresses.empty() ? NULL : &addresses[0],
+                   addresses.size() * sizeof(addresses[0]), offset, file)) {
+    return false;
+  }
+  for (size_t column = 0; column < columns.size(); ++column) {
+    if (!WriteBinary(&columns[column][0],
+                     addresses.size() * sizeof(columns[column][0]), offset,
+                     file)) {
+      return false;
+    }
+  }
+
+  return WriteBinaryPadding(kBinaryRecordAlignment, offset, file);
+}
+
+bool ReadBinaryFrequencyData(const uint8* data,
+                             size_t data_size,
+                             size_t* offset,
+                             ModuleIndexedFrequencyMap* module_frequency_map) {
+  DCHECK(data != NULL);
+  DCHECK(offset != NULL);
+  DCHECK(module_frequency_map != NULL);
+
+  const void* range = NULL;
+  if (!ReadBinary(data, data_size, sizeof(BinaryModuleHeader), offset,
+                  &range)) {
+    return false;
+  }
+  const BinaryModuleHeader* header =
+      reinterpret_cast<const BinaryModuleHeader*>(range);
+
+  if (header->data_type == common::IndexedFrequencyData::INVALID_DATA_TYPE ||
+      header->data_type >= common::IndexedFrequencyData::MAX_DATA_TYPE) {
+    LOG(ERROR) << "Invalid data type in binary frequency data.";
+    return false;
+  }
+
+  // The path is followed by the columns of relative addresses and
+  // frequencies.
+  if (!ReadBinary(data, data_size, header->path_length * sizeof(wchar_t),
+                  offset, &range)) {
+    return false;
+  }
+  const wchar_t* path = reinterpret_cast<const wchar_t*>(range);
+  *offset = common::AlignUp(*offset, kBinaryPathAlignment);
+
+  // Guard against the size of the columns overflowing.
+  uint64 columns_size = static_cast<uint64>(header->num_rows) *
+      (header->num_data_columns + 1) * sizeof(uint32);
+  if (columns_size > data_size ||
+      !ReadBinary(data, data_size, static_cast<size_t>(columns_size), offset,
+                  &range)) {
+    LOG(ERROR) << "Invalid frequency columns in binary frequency data.";
+    return false;
+  }
+  const uint32* addresses = reinterpret_cast<const uint32*>(range);
+  const EntryCountType* frequencies =
+      reinterpret_cast<const EntryCountType*>(addresses + header->num_rows);
+  *offset = common::AlignUp(*offset, kBinaryRecordAlignment);
+
+  ModuleInformation module_information;
+  module_information.base_address = header->base_address;
+  module_information.image_checksum = header->image_checksum;
+  module_information.image_file_name.assign(path, header->path_length);
+  module_information.module_size = header->module_size;
+  module_information.time_date_stamp = header->time_date_stamp;
+
+  // Insert a new IndexedFrequencyMap record for this module.
+  std::pair<ModuleIndexedFrequencyMap::iterator, bool> result =
+      module_frequency_map->insert(std::make_pair(
+          module_information, IndexedFrequencyInformation()));
+  if (!result.second) {
+    LOG(ERROR) << "Found duplicate entries for "
+               << module_information.image_file_name << ".";
+    return false;
+  }
+
+  IndexedFrequencyInformation& frequency_info = result.first->second;
+  frequency_info.num_entries = header->num_entries;
+  frequency_info.num_columns = header->num_columns;
+  frequency_info.data_type =
+      static_cast<common::IndexedFrequencyData::DataType>(header->data_type);
+  frequency_info.frequency_size = header->frequency_size;
+
+  // The relative addresses are sorted, so the entries are added in the order
+  // of the map.
+  IndexedFrequencyMap& values = frequency_info.frequency_map;
+  for (size_t row = 0; row < header->num_rows; ++row) {
+    if (row > 0 && addresses[row] <= addresses[row - 1]) {
+      LOG(ERROR) << "Unsorted relative addresses in binary frequency data.";
+      return false;
+    }
+    if (static_cast<int32>(addresses[row]) < 0) {
+      LOG(ERROR) << "Invalid relative address in binary frequency data.";
+      return false;
+    }
+
+    RelativeAddress address(addresses[row]);
+    for (size_t column = 0; column < header->num_data_columns; ++column) {
+      EntryCountType entry_count =
+          frequencies[column * header->num_rows + row];
+      if (entry_count < 0) {
+        LOG(ERROR) << "Invalid value in binary frequency data.";
+        return false;
+      }
+      values.insert(values.end(),
+                    std::make_pair(std::make_pair(address, column),
+                                   entry_count));
+    }
+  }
+
+  return true;
+}
+
 bool OutputFrequencyData(
     JSONFileWriter* writer,
     const ModuleInformation& module_information,
@@ -333,6 +661,92 @@ bool IndexedFrequencyDataSerializer::LoadFromJson(
   return true;
 }
 
+bool IndexedFrequencyDataSerializer::SaveAsBinary(
+    const ModuleIndexedFrequencyMap& frequency_map, FILE* file) {
+  DCHECK(file != NULL);
+
+  // The file may have been opened in text mode, e.g. if it's stdout.
+  if (::_setmode(::_fileno(file), _O_BINARY) == -1) {
+    LOG(ERROR) << "Failed to switch the output to binary mode.";
+    return false;
+  }
+
+  BinaryFileHeader header = {};
+  header.magic = kBinaryMagic;
+  header.version = kBinaryVersion;
+  header.num_modules = frequency_map.size();
+
+  size_t offset = 0;
+  if (!WriteBinary(&header, sizeof(header), &offset, file))
+    return false;
+
+  ModuleIndexedFrequencyMap::const_iterator it = frequency_map.begin();
+  for (; it != frequency_map.end(); ++it) {
+    if (!OutputBinaryFrequencyData(it->first, it->second, &offset, file))
+      return false;
+  }
+
+  return true;
+}
+
+bool IndexedFrequencyDataSerializer::SaveAsBinary(
+    const ModuleIndexedFrequencyMap& frequency_map,
+    const base::FilePath& path) {
+  DCHECK(!path.empty());
+  file_util::ScopedFILE file(file_util::OpenFile(path, "wb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Failed to open " << path.value() << " for writing.";
+    return false;
+  }
+
+  if (!SaveAsBinary(frequency_map, file.get())) {
+    LOG(ERROR) << "Failed to write binary data to " << path.value() << ".";
+    return false;
+  }
+
+  return true;
+}
+
+bool IndexedFrequencyDataSerializer::LoadFromBinary(
+    const base::FilePath& path,
+    ModuleIndexedFrequencyMap* module_frequency_map) {
+  DCHECK(module_frequency_map != NULL);
+  DCHECK(!path.empty());
+
+  // The view logs verbosely for us.
+  ScopedFileView view;
+  if (!view.Init(path))
+    return false;
+
+  if (!PopulateFromBinary(view.data(), view.size(), module_frequency_map)) {
+    LOG(ERROR) << "Failed to parse '" << path.value() << "' as binary "
+               << "frequency data.";
+    return false;
+  }
+
+  return true;
+}
+
+bool IndexedFrequencyDataSerializer::Load(
+    const base::FilePath& path,
+    ModuleIndexedFrequencyMap* module_frequency_map) {
+  if (IsBinaryFile(path))
+    return LoadFromBinary(path, module_frequency_map);
+  return LoadFromJson(path, module_frequency_map);
+}
+
+bool IndexedFrequencyDataSerializer::IsBinaryFile(const base::FilePath& path) {
+  file_util::ScopedFILE file(file_util::OpenFile(path, "rb"));
+  if (file.get() == NULL)
+    return false;
+
+  uint32 magic = 0;
+  if (::fread(&magic, sizeof(magic), 1, file.get()) != 1)
+    return false;
+
+  return magic == kBinaryMagic;
+}
+
 bool IndexedFrequencyDataSerializer::PopulateFromJsonValue(
     const base::Value* json_value,
     ModuleIndexedFrequencyMap* module_frequency_map) {
@@ -365,4 +779,42 @@ bool IndexedFrequencyDataSerializer::PopulateFromJsonValue(
   return true;
 }
 
+bool IndexedFrequencyDataSerializer::PopulateFromBinary(
+    const uint8* data,
+    size_t data_size,
+    ModuleIndexedFrequencyMap* module_frequency_map) {
+  DCHECK(data != NULL);
+  DCHECK(module_frequency_map != NULL);
+
+  module_frequency_map->clear();
+
+  size_t offset = 0;
+  const void* range = NULL;
+  if (!ReadBinary(data, data_size, sizeof(BinaryFileHeader), &offset,
+                  &range)) {
+    return false;
+  }
+  const BinaryFileHeader* header =
+      reinterpret_cast<const BinaryFileHeader*>(range);
+  if (header->magic != kBinaryMagic) {
+    LOG(ERROR) << "Invalid binary frequency data header.";
+    return false;
+  }
+  if (header->version != kBinaryVersion) {
+    LOG(ERROR) << "Unsupported binary frequency data version: "
+               << header->version << ".";
+    return false;
+  }
+
+  for (size_t i = 0; i < header->num_modules; ++i) {
+    if (!ReadBinaryFrequencyData(data, data_size, &offset,
+                                 module_frequency_map)) {
+      // ReadBinaryFrequencyData() has already logged the error.
+      return false;
+    }
+  }
+
+  return true;
+}
+
 }  // namespace grinder
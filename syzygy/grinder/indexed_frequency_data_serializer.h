@@ -73,6 +73,40 @@ namespace grinder {
 //       // Basic-block frequencies list for module 2.
 //       ...
 //     ]
+//
+// As the JSON files get large and slow to parse for images with millions of
+// basic blocks, the frequency map may also be saved in a binary format. This
+// is laid out so that it can be read straight out of a memory mapped view of
+// the file. All values are little-endian and aligned on their natural
+// boundaries. The file starts with a header:
+//
+//     uint32 magic;  // 'SZFQ'.
+//     uint32 version;
+//     uint32 num_modules;
+//     uint32 reserved;
+//
+// The header is followed by a record for each module, which starts with a
+// module header:
+//
+//     uint64 base_address;
+//     uint32 module_size;
+//     uint32 image_checksum;
+//     uint32 time_date_stamp;
+//     uint32 num_entries;
+//     uint32 num_columns;
+//     uint32 data_type;
+//     uint32 frequency_size;
+//     uint32 path_length;
+//     uint32 num_rows;
+//     uint32 num_data_columns;
+//
+// The module header is followed by the path of the module, as path_length
+// wide characters, and then by the frequencies as columns of num_rows values:
+// first the relative addresses of the basic blocks, in increasing order, then
+// num_data_columns columns of frequencies. Both the path and the module record
+// are padded with zeros to be 4- and 8-byte aligned, respectively. Just as in
+// the JSON format, the basic blocks whose frequencies are all zero are left
+// out.
 class IndexedFrequencyDataSerializer {
  public:
   typedef basic_block_util::ModuleIndexedFrequencyMap ModuleIndexedFrequencyMap;
@@ -94,12 +128,46 @@ class IndexedFrequencyDataSerializer {
   bool LoadFromJson(const base::FilePath& file_path,
                     ModuleIndexedFrequencyMap* frequency_map);
 
+  // Saves the given frequency map in the binary format to a file at
+  // @p file_path.
+  bool SaveAsBinary(const ModuleIndexedFrequencyMap& frequency_map,
+                    const base::FilePath& file_path);
+
+  // Saves the given frequency map in the binary format to a file previously
+  // opened for writing. The file is switched to binary mode.
+  bool SaveAsBinary(const ModuleIndexedFrequencyMap& frequency_map,
+                    FILE* file);
+
+  // Populates a frequency map from a binary file, given by @p file_path. The
+  // file is memory mapped rather than read.
+  bool LoadFromBinary(const base::FilePath& file_path,
+                      ModuleIndexedFrequencyMap* frequency_map);
+
+  // Populates a frequency map from a file in either format, given by
+  // @p file_path.
+  bool Load(const base::FilePath& file_path,
+            ModuleIndexedFrequencyMap* frequency_map);
+
+  // @param file_path the path of the file to check.
+  // @returns true if @p file_path is a file in the binary format.
+  static bool IsBinaryFile(const base::FilePath& file_path);
+
  protected:
   // Populates a frequency map from JSON data. Exposed for unit-testing
   // purposes.
   bool PopulateFromJsonValue(const base::Value* json_value,
                              ModuleIndexedFrequencyMap* frequency_map);
 
+  // Populates a frequency map from data in the binary format. Exposed for
+  // unit-testing purposes.
+  // @param data the binary data.
+  // @param data_size the size of @p data, in bytes.
+  // @param frequency_map the frequency map to populate.
+  // @returns true on success, false otherwise.
+  bool PopulateFromBinary(const uint8* data,
+                          size_t data_size,
+                          ModuleIndexedFrequencyMap* frequency_map);
+
   // If true, the JSON output will be pretty printed for easier human
   // consumption.
   bool pretty_print_;
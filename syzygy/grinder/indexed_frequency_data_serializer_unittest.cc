@@ -49,6 +49,7 @@ const uint32 kTimeDateStamp = 0xBABECAFE;
 class TestIndexedFrequencyDataSerializer
     : public IndexedFrequencyDataSerializer {
  public:
+  using IndexedFrequencyDataSerializer::PopulateFromBinary;
   using IndexedFrequencyDataSerializer::PopulateFromJsonValue;
   using IndexedFrequencyDataSerializer::pretty_print_;
 };
@@ -70,6 +71,30 @@ class IndexedFrequencyDataSerializerTest : public testing::PELibUnitTest {
     module_info->image_checksum = kImageChecksum;
     module_info->time_date_stamp = kTimeDateStamp;
   }
+
+  void InitFrequencyMap(ModuleIndexedFrequencyMap* frequency_map) {
+    ASSERT_TRUE(frequency_map != NULL);
+
+    ModuleInformation module_info;
+    ASSERT_NO_FATAL_FAILURE(InitModuleInfo(&module_info));
+
+    size_t num_basic_blocks = 100;
+    size_t num_columns = 10;
+
+    IndexedFrequencyInformation& frequency_info =
+        (*frequency_map)[module_info];
+    frequency_info.num_entries = num_basic_blocks;
+    frequency_info.num_columns = num_columns;
+    frequency_info.data_type = common::IndexedFrequencyData::BRANCH;
+    frequency_info.frequency_size = 4;
+    frequency_info.frequency_map = IndexedFrequencyMap();
+
+    IndexedFrequencyMap& counters = frequency_info.frequency_map;
+    for (size_t i = 0; i < num_basic_blocks; ++i) {
+      for (size_t c = 0; c < num_columns; ++c)
+        counters[std::make_pair(i * i, c)] = i + c + 1;
+    }
+  }
  protected:
   base::ScopedTempDir temp_dir_;
 };
@@ -240,4 +265,83 @@ TEST_F(IndexedFrequencyDataSerializerTest, RoundTrip) {
   EXPECT_THAT(new_frequency_map, ContainerEq(frequency_map));
 }
 
+TEST_F(IndexedFrequencyDataSerializerTest, BinaryRoundTrip) {
+  ModuleIndexedFrequencyMap frequency_map;
+  ASSERT_NO_FATAL_FAILURE(InitFrequencyMap(&frequency_map));
+
+  // A second module, with an odd-length path and all-zero entries which are
+  // left out of the output.
+  ModuleInformation module_info;
+  ASSERT_NO_FATAL_FAILURE(InitModuleInfo(&module_info));
+  module_info.image_file_name = L"bar.exe";
+  IndexedFrequencyInformation& frequency_info = frequency_map[module_info];
+  frequency_info.num_entries = 3;
+  frequency_info.num_columns = 1;
+  frequency_info.data_type = common::IndexedFrequencyData::BASIC_BLOCK_ENTRY;
+  frequency_info.frequency_size = 1;
+  frequency_info.frequency_map[std::make_pair(0, 0)] = 0;
+  frequency_info.frequency_map[std::make_pair(16, 0)] = 7;
+
+  base::FilePath binary_path(temp_dir_.path().AppendASCII("test.bin"));
+
+  TestIndexedFrequencyDataSerializer serializer;
+  ASSERT_TRUE(serializer.SaveAsBinary(frequency_map, binary_path));
+  EXPECT_TRUE(IndexedFrequencyDataSerializer::IsBinaryFile(binary_path));
+
+  ModuleIndexedFrequencyMap new_frequency_map;
+  ASSERT_TRUE(serializer.LoadFromBinary(binary_path, &new_frequency_map));
+
+  frequency_info.frequency_map.erase(std::make_pair(0, 0));
+  EXPECT_THAT(new_frequency_map, ContainerEq(frequency_map));
+}
+
+TEST_F(IndexedFrequencyDataSerializerTest, LoadDetectsFormat) {
+  ModuleIndexedFrequencyMap frequency_map;
+  ASSERT_NO_FATAL_FAILURE(InitFrequencyMap(&frequency_map));
+
+  base::FilePath json_path(temp_dir_.path().AppendASCII("test.json"));
+  base::FilePath binary_path(temp_dir_.path().AppendASCII("test.bin"));
+
+  TestIndexedFrequencyDataSerializer serializer;
+  ASSERT_TRUE(serializer.SaveAsJson(frequency_map, json_path));
+  ASSERT_TRUE(serializer.SaveAsBinary(frequency_map, binary_path));
+  EXPECT_FALSE(IndexedFrequencyDataSerializer::IsBinaryFile(json_path));
+
+  ModuleIndexedFrequencyMap json_frequency_map;
+  ASSERT_TRUE(serializer.Load(json_path, &json_frequency_map));
+  EXPECT_THAT(json_frequency_map, ContainerEq(frequency_map));
+
+  ModuleIndexedFrequencyMap binary_frequency_map;
+  ASSERT_TRUE(serializer.Load(binary_path, &binary_frequency_map));
+  EXPECT_THAT(binary_frequency_map, ContainerEq(frequency_map));
+}
+
+TEST_F(IndexedFrequencyDataSerializerTest, PopulateFromBinaryFails) {
+  ModuleIndexedFrequencyMap frequency_map;
+  ASSERT_NO_FATAL_FAILURE(InitFrequencyMap(&frequency_map));
+
+  base::FilePath binary_path(temp_dir_.path().AppendASCII("test.bin"));
+  TestIndexedFrequencyDataSerializer serializer;
+  ASSERT_TRUE(serializer.SaveAsBinary(frequency_map, binary_path));
+  std::string data;
+  ASSERT_TRUE(file_util::ReadFileToString(binary_path, &data));
+  const uint8* bytes = reinterpret_cast<const uint8*>(data.data());
+
+  ModuleIndexedFrequencyMap new_frequency_map;
+  ASSERT_TRUE(serializer.PopulateFromBinary(bytes, data.size(),
+                                            &new_frequency_map));
+
+  // It should fail on truncated data.
+  EXPECT_FALSE(serializer.PopulateFromBinary(bytes, 8, &new_frequency_map));
+  EXPECT_FALSE(serializer.PopulateFromBinary(bytes, data.size() - 8,
+                                             &new_frequency_map));
+
+  // It should fail on an invalid header.
+  std::string invalid_data(data);
+  invalid_data[0] = 'X';
+  EXPECT_FALSE(serializer.PopulateFromBinary(
+      reinterpret_cast<const uint8*>(invalid_data.data()), invalid_data.size(),
+      &new_frequency_map));
+}
+
 }  // namespace grinder
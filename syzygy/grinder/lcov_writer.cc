@@ -15,6 +15,9 @@
 #include "syzygy/grinder/lcov_writer.h"
 
 #include "base/file_util.h"
+#include "base/string_number_conversions.h"
+#include "base/string_split.h"
+#include "base/string_util.h"
 
 namespace grinder {
 
@@ -37,32 +40,32 @@ bool WriteLcovCoverageFile(const CoverageData& coverage,
 bool WriteLcovCoverageFile(const CoverageData& coverage, FILE* file) {
   DCHECK(file != NULL);
 
-  CoverageData::SourceFileCoverageDataMap::const_iterator source_it =
-      coverage.source_file_coverage_data_map().begin();
-  CoverageData::SourceFileCoverageDataMap::const_iterator source_it_end =
-      coverage.source_file_coverage_data_map().end();
-  for (; source_it != source_it_end; ++source_it) {
+  // Stream the source files out in order of name.
+  CoverageData::SourceFileIdMap::const_iterator source_it =
+      coverage.source_file_ids().begin();
+  for (; source_it != coverage.source_file_ids().end(); ++source_it) {
+    const CoverageData::SourceFileCoverageData& source_file =
+        coverage.source_files()[source_it->second];
     if (::fprintf(file, "SF:%s\n", source_it->first.c_str()) < 0)
       return false;
 
     // Iterate over the line execution data, keeping summary statistics as we
     // go.
     size_t lines_executed = 0;
-    CoverageData::LineExecutionCountMap::const_iterator line_it =
-        source_it->second.line_execution_count_map.begin();
-    CoverageData::LineExecutionCountMap::const_iterator line_it_end =
-        source_it->second.line_execution_count_map.end();
-    for (; line_it != line_it_end; ++line_it) {
-      if (::fprintf(file, "DA:%d,%d\n", line_it->first, line_it->second) < 0)
+    for (size_t line = 0; line < source_file.line_execution_counts.size();
+         ++line) {
+      if (!source_file.instrumented_lines[line])
+        continue;
+      uint32 count = source_file.line_execution_counts[line];
+      if (::fprintf(file, "DA:%d,%d\n", line, count) < 0)
         return false;
-      if (line_it->second > 0)
+      if (count > 0)
         ++lines_executed;
     }
 
     // Output the summary statistics for this file.
     if (::fprintf(file, "LH:%d\n", lines_executed) < 0 ||
-        ::fprintf(file, "LF:%d\n",
-                  source_it->second.line_execution_count_map.size()) < 0 ||
+        ::fprintf(file, "LF:%d\n", source_file.num_instrumented_lines) < 0 ||
         ::fprintf(file, "end_of_record\n") < 0) {
       return false;
     }
@@ -71,4 +74,54 @@ bool WriteLcovCoverageFile(const CoverageData& coverage, FILE* file) {
   return true;
 }
 
+bool ReadLcovCoverageFile(const base::FilePath& path, CoverageData* coverage) {
+  DCHECK(coverage != NULL);
+
+  std::string contents;
+  if (!file_util::ReadFileToString(path, &contents)) {
+    LOG(ERROR) << "Failed to read LCOV file: " << path.value();
+    return false;
+  }
+
+  // This trims the whitespace surrounding each line.
+  std::vector<std::string> lines;
+  base::SplitString(contents, '\n', &lines);
+
+  std::string source_file_name;
+  for (size_t i = 0; i < lines.size(); ++i) {
+    const std::string& line = lines[i];
+
+    if (StartsWithASCII(line, "SF:", true)) {
+      TrimWhitespaceASCII(line.substr(3), TRIM_ALL, &source_file_name);
+      continue;
+    }
+
+    if (line == "end_of_record") {
+      source_file_name.clear();
+      continue;
+    }
+
+    // The remaining tags hold summary or unsupported information.
+    if (!StartsWithASCII(line, "DA:", true))
+      continue;
+
+    // A DA record may carry a checksum of the line after its execution count.
+    std::vector<std::string> fields;
+    base::SplitString(line.substr(3), ',', &fields);
+    size_t line_number = 0;
+    unsigned execution_count = 0;
+    if (source_file_name.empty() || fields.size() < 2 ||
+        !base::StringToSizeT(fields[0], &line_number) ||
+        !base::StringToUint(fields[1], &execution_count)) {
+      LOG(ERROR) << "Invalid DA record on line " << i + 1 << " of LCOV file: "
+                 << path.value();
+      return false;
+    }
+
+    coverage->AddLine(source_file_name, line_number, execution_count);
+  }
+
+  return true;
+}
+
 }  // namespace grinder
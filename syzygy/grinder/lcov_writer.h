@@ -99,6 +99,14 @@ bool WriteLcovCoverageFile(const CoverageData& coverage,
                            const base::FilePath& path);
 bool WriteLcovCoverageFile(const CoverageData& coverage, FILE* file);
 
+// Reads an LCOV file, adding the line execution counts it contains to
+// @p coverage. Only the SF and DA tags are interpreted, which suffices to read
+// the files produced by WriteLcovCoverageFile back in.
+// @param path the path to the file to be read.
+// @param coverage the coverage info to which the file contents are added.
+// @returns true on success, false otherwise.
+bool ReadLcovCoverageFile(const base::FilePath& path, CoverageData* coverage);
+
 }  // namespace grinder
 
 #endif  // SYZYGY_GRINDER_LCOV_WRITER_H_
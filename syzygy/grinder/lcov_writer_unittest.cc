@@ -26,17 +26,9 @@ namespace {
 class TestCoverageData : public CoverageData {
  public:
   void InitDummyData() {
-    CoverageData::SourceFileCoverageDataMap::iterator source_it =
-        source_file_coverage_data_map_.insert(
-            std::make_pair(std::string("foo.cc"),
-                           CoverageData::SourceFileCoverageData())).first;
-
-    source_it->second.line_execution_count_map.insert(
-        std::make_pair(1, 1));
-    source_it->second.line_execution_count_map.insert(
-        std::make_pair(2, 1));
-    source_it->second.line_execution_count_map.insert(
-        std::make_pair(3, 0));
+    AddLine("foo.cc", 1, 1);
+    AddLine("foo.cc", 2, 1);
+    AddLine("foo.cc", 3, 0);
   }
 };
 
@@ -64,4 +56,72 @@ TEST(LcovWriterTest, Write) {
   EXPECT_EQ(expected_contents, actual_contents);
 }
 
+TEST(LcovWriterTest, Read) {
+  testing::ScopedTempFile temp;
+  std::string contents =
+      "TN:test\n"
+      "SF:foo.cc\n"
+      "DA:1,1\n"
+      "DA:2,1\n"
+      "DA:3,0\n"
+      "LH:2\n"
+      "LF:3\n"
+      "end_of_record\n"
+      "SF:bar.cc\r\n"
+      "DA:7,4,checksum\r\n"
+      "end_of_record\r\n";
+  ASSERT_EQ(static_cast<int>(contents.size()),
+            file_util::WriteFile(temp.path(), contents.c_str(),
+                                 contents.size()));
+
+  CoverageData coverage_data;
+  coverage_data.AddLine("foo.cc", 1, 2);
+  EXPECT_TRUE(ReadLcovCoverageFile(temp.path(), &coverage_data));
+
+  CoverageData::SourceFileCoverageData expected_foo;
+  expected_foo.source_file_name = "foo.cc";
+  expected_foo.AddLine(1, 3);
+  expected_foo.AddLine(2, 1);
+  expected_foo.AddLine(3, 0);
+  const CoverageData::SourceFileCoverageData* source_file =
+      coverage_data.FindSourceFile("foo.cc");
+  ASSERT_TRUE(source_file != NULL);
+  EXPECT_TRUE(expected_foo == *source_file);
+
+  CoverageData::SourceFileCoverageData expected_bar;
+  expected_bar.source_file_name = "bar.cc";
+  expected_bar.AddLine(7, 4);
+  source_file = coverage_data.FindSourceFile("bar.cc");
+  ASSERT_TRUE(source_file != NULL);
+  EXPECT_TRUE(expected_bar == *source_file);
+}
+
+TEST(LcovWriterTest, ReadWrittenFile) {
+  TestCoverageData coverage_data;
+  ASSERT_NO_FATAL_FAILURE(coverage_data.InitDummyData());
+
+  testing::ScopedTempFile temp;
+  ASSERT_TRUE(WriteLcovCoverageFile(coverage_data, temp.path()));
+
+  CoverageData read_coverage_data;
+  EXPECT_TRUE(ReadLcovCoverageFile(temp.path(), &read_coverage_data));
+
+  ASSERT_EQ(1U, read_coverage_data.source_files().size());
+  const CoverageData::SourceFileCoverageData* source_file =
+      read_coverage_data.FindSourceFile("foo.cc");
+  ASSERT_TRUE(source_file != NULL);
+  EXPECT_TRUE(*coverage_data.FindSourceFile("foo.cc") == *source_file);
+}
+
+TEST(LcovWriterTest, ReadFailsForInvalidFile) {
+  testing::ScopedTempFile temp;
+  std::string contents = "SF:foo.cc\nDA:one,1\nend_of_record\n";
+  ASSERT_EQ(static_cast<int>(contents.size()),
+            file_util::WriteFile(temp.path(), contents.c_str(),
+                                 contents.size()));
+
+  CoverageData coverage_data;
+  EXPECT_FALSE(ReadLcovCoverageFile(temp.path(), &coverage_data));
+}
+
 }  // namespace grinder
@@ -19,6 +19,8 @@
 #include <limits>
 
 #include "base/utf_string_conversions.h"
+#include "base/memory/scoped_vector.h"
+#include "base/threading/simple_thread.h"
 #include "base/win/scoped_bstr.h"
 #include "base/win/scoped_comptr.h"
 #include "sawbuck/common/com_utils.h"
@@ -128,6 +130,96 @@ struct SourceLineAddressComparator {
   }
 };
 
+// Adds @p count visits to @p source_line. We use saturation arithmetic here as
+// overflow is a real possibility in long trace files.
+void AddVisits(size_t count, LineInfo::SourceLine* source_line) {
+  DCHECK(source_line != NULL);
+  source_line->visit_count =
+      std::min(source_line->visit_count,
+               std::numeric_limits<uint32>::max() - count) + count;
+}
+
+// Sweeps sorted address ranges against the source lines in
+// [@p lines_begin, @p lines_end), visiting those they intersect. Only these
+// source lines are modified, which allows disjoint sets of source lines to be
+// swept concurrently.
+void SweepVisitedRanges(const LineInfo::VisitedRanges& ranges,
+                        size_t first_range,
+                        LineInfo::SourceLines::iterator lines_begin,
+                        LineInfo::SourceLines::iterator lines_end) {
+  LineInfo::SourceLines::iterator line_it = lines_begin;
+  for (size_t i = first_range; i < ranges.size(); ++i) {
+    const LineInfo::VisitedRange& range = ranges[i];
+
+    // Visiting a range of size zero is a nop.
+    if (range.size == 0)
+      continue;
+
+    // Skip the lines that end before this range, and hence before all of the
+    // ranges that follow.
+    while (line_it != lines_end &&
+           line_it->address + line_it->size <= range.address) {
+      ++line_it;
+    }
+    if (line_it == lines_end)
+      break;
+
+    RelativeAddressRange visit(range.address, range.size);
+    LineInfo::SourceLines::iterator it = line_it;
+    for (; it != lines_end && it->address < visit.end(); ++it) {
+      if (visit.Intersects(RelativeAddressRange(it->address, it->size)))
+        AddVisits(range.count, &(*it));
+    }
+  }
+}
+
+// Sweeps sorted address ranges against a partition of the source lines on a
+// worker thread.
+class SweepWorker : public base::DelegateSimpleThread::Delegate {
+ public:
+  SweepWorker(const LineInfo::VisitedRanges& ranges,
+              size_t first_range,
+              LineInfo::SourceLines::iterator lines_begin,
+              LineInfo::SourceLines::iterator lines_end)
+      : ranges_(ranges),
+        first_range_(first_range),
+        lines_begin_(lines_begin),
+        lines_end_(lines_end) {
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  virtual void Run() OVERRIDE {
+    SweepVisitedRanges(ranges_, first_range_, lines_begin_, lines_end_);
+  }
+  // @}
+
+ private:
+  const LineInfo::VisitedRanges& ranges_;
+  size_t first_range_;
+  LineInfo::SourceLines::iterator lines_begin_;
+  LineInfo::SourceLines::iterator lines_end_;
+
+  DISALLOW_COPY_AND_ASSIGN(SweepWorker);
+};
+
+bool AreVisitedRangesSorted(const LineInfo::VisitedRanges& ranges) {
+  for (size_t i = 1; i < ranges.size(); ++i) {
+    if (ranges[i].address < ranges[i - 1].address) {
+      LOG(ERROR) << "Visited ranges aren't sorted by address.";
+      return false;
+    }
+  }
+  return true;
+}
+
+struct VisitedRangeAddressComparator {
+  bool operator()(const LineInfo::VisitedRange& range,
+                  core::RelativeAddress address) const {
+    return range.address < address;
+  }
+};
+
 }  // namespace
 
 bool LineInfo::Init(const base::FilePath& pdb_path) {
@@ -266,16 +358,67 @@ bool LineInfo::Visit(
   RelativeAddressRange visit(address, size);
   for (; it != end_it; ++it) {
     RelativeAddressRange range(it->address, it->size);
-    if (visit.Intersects(range)) {
-      // We use saturation arithmetic here as overflow is a real possibility in
-      // long trace files.
-      it->visit_count =
-          std::min(it->visit_count,
-                   std::numeric_limits<uint32>::max() - count) + count;
-    }
+    if (visit.Intersects(range))
+      AddVisits(count, &(*it));
   }
 
   return true;
 }
 
+bool LineInfo::VisitRanges(const VisitedRanges& ranges) {
+  if (!AreVisitedRangesSorted(ranges))
+    return false;
+
+  SweepVisitedRanges(ranges, 0, source_lines_.begin(), source_lines_.end());
+  return true;
+}
+
+bool LineInfo::VisitRanges(const VisitedRanges& ranges, size_t num_threads) {
+  if (!AreVisitedRangesSorted(ranges))
+    return false;
+
+  num_threads = std::min(num_threads, source_lines_.size());
+  if (num_threads <= 1) {
+    SweepVisitedRanges(ranges, 0, source_lines_.begin(), source_lines_.end());
+    return true;
+  }
+
+  // A range may intersect the lines of a partition while starting before it,
+  // by at most the size of the largest range.
+  size_t max_range_size = 0;
+  for (size_t i = 0; i < ranges.size(); ++i)
+    max_range_size = std::max(max_range_size, ranges[i].size);
+
+  // Partition the source lines evenly. Each worker only modifies the lines of
+  // its own partition, so they don't need to synchronize.
+  ScopedVector<SweepWorker> workers;
+  size_t lines_per_thread =
+      (source_lines_.size() + num_threads - 1) / num_threads;
+  for (size_t begin = 0; begin < source_lines_.size();
+       begin += lines_per_thread) {
+    size_t end = std::min(begin + lines_per_thread, source_lines_.size());
+
+    core::RelativeAddress first_address(0);
+    if (source_lines_[begin].address.value() > max_range_size)
+      first_address = source_lines_[begin].address - max_range_size;
+    size_t first_range = std::lower_bound(ranges.begin(), ranges.end(),
+                                          first_address,
+                                          VisitedRangeAddressComparator()) -
+        ranges.begin();
+
+    workers.push_back(new SweepWorker(ranges, first_range,
+                                      source_lines_.begin() + begin,
+                                      source_lines_.begin() + end));
+  }
+
+  base::DelegateSimpleThreadPool pool("LineInfo",
+                                      static_cast<int>(workers.size()));
+  pool.Start();
+  for (size_t i = 0; i < workers.size(); ++i)
+    pool.AddWork(workers[i]);
+  pool.JoinAll();
+
+  return true;
+}
+
 }  // namespace grinder
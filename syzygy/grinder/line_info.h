@@ -33,15 +33,13 @@ namespace grinder {
 //     visited. We need finer grained bookkeeping to accomodate this (the
 //     LCOV file format can handle it just fine). The MSVC tools do not seem to
 //     make a distinction between partially and fully covered lines.
-//
-// TODO(chrisha): Make a more efficient sorted-collection-based version of
-//     Visit. This can be O(N) rather than O(N log N) and would be useful with
-//     the coverage grinder.
 class LineInfo {
  public:
   struct SourceLine;  // Forward declaration.
+  struct VisitedRange;  // Forward declaration.
   typedef std::set<std::string> SourceFileSet;
   typedef std::vector<SourceLine> SourceLines;
+  typedef std::vector<VisitedRange> VisitedRanges;
 
   // Initializes this LineInfo object with data read from the provided PDB.
   // @param pdb_path the PDB whose line information is to be read.
@@ -55,6 +53,23 @@ class LineInfo {
   // @param the number of times to visit this line.
   bool Visit(core::RelativeAddress address, size_t size, size_t count);
 
+  // Visits a batch of address ranges, with the same semantics as calling
+  // Visit for each of them. As the ranges are sorted, they are swept against
+  // the source lines in a single pass, which is much faster than looking up
+  // each range on its own.
+  // @param ranges the address ranges to visit, sorted by address. They may
+  //     overlap.
+  // @returns true on success, false if the ranges aren't sorted.
+  bool VisitRanges(const VisitedRanges& ranges);
+
+  // A version of VisitRanges that partitions the source lines by address and
+  // sweeps the ranges against each partition on a thread of its own. This
+  // only pays off for large batches of ranges.
+  // @param ranges the address ranges to visit, sorted by address.
+  // @param num_threads the number of threads to use.
+  // @returns true on success, false if the ranges aren't sorted.
+  bool VisitRanges(const VisitedRanges& ranges, size_t num_threads);
+
   // @name Accessors.
   // @{
   const SourceFileSet& source_files() const { return source_files_; }
@@ -99,6 +114,20 @@ struct LineInfo::SourceLine {
   uint32 visit_count;
 };
 
+// Describes a visit of an address range, for use with VisitRanges.
+struct LineInfo::VisitedRange {
+  VisitedRange(core::RelativeAddress address, size_t size, size_t count)
+      : address(address), size(size), count(count) {
+  }
+
+  // The starting address of the address range.
+  core::RelativeAddress address;
+  // The size of the address range.
+  size_t size;
+  // The number of times the address range was visited.
+  size_t count;
+};
+
 }  // namespace grinder
 
 #endif  // SYZYGY_GRINDER_LINE_INFO_H_
@@ -34,6 +34,13 @@ class TestLineInfo : public LineInfo {
     }
   }
 
+  void GetVisitCounts(std::vector<uint32>* visit_counts) const {
+    DCHECK(visit_counts != NULL);
+    visit_counts->clear();
+    for (size_t i = 0; i < source_lines_.size(); ++i)
+      visit_counts->push_back(source_lines_[i].visit_count);
+  }
+
   void GetVisitedLines(std::vector<size_t>* visited_lines) const {
     DCHECK(visited_lines != NULL);
     visited_lines->clear();
@@ -76,6 +83,49 @@ void PushBackSourceLine(
       size));
 }
 
+// Creates a layout of @p num_lines source lines with repeated ranges, gaps
+// and lines of various sizes.
+void InitSyntheticLines(size_t num_lines,
+                        const std::string* source_file_name,
+                        TestLineInfo* line_info) {
+  DCHECK(line_info != NULL);
+  uint32 address = 4096;
+  size_t size = 0;
+  for (size_t i = 0; i < num_lines; ++i) {
+    // Every fifth line shares its range with the next one.
+    if (i % 5 != 1)
+      size = 1 + i % 7;
+    PushBackSourceLine(line_info, source_file_name, i + 1, address, size);
+    if (i % 5 != 0)
+      address += size;
+    // Every third line is followed by a gap.
+    if (i % 3 == 0)
+      address += 3;
+  }
+}
+
+// Visits @p ranges one at a time through Visit on @p expected, and as a batch
+// on @p line_info, and expects the same visit counts to result.
+void ExpectVisitRangesMatchesVisit(const LineInfo::VisitedRanges& ranges,
+                                   size_t num_threads,
+                                   TestLineInfo* expected,
+                                   TestLineInfo* line_info) {
+  for (size_t i = 0; i < ranges.size(); ++i)
+    EXPECT_TRUE(expected->Visit(ranges[i].address, ranges[i].size,
+                                ranges[i].count));
+  if (num_threads == 0) {
+    EXPECT_TRUE(line_info->VisitRanges(ranges));
+  } else {
+    EXPECT_TRUE(line_info->VisitRanges(ranges, num_threads));
+  }
+
+  std::vector<uint32> expected_counts;
+  std::vector<uint32> visit_counts;
+  expected->GetVisitCounts(&expected_counts);
+  line_info->GetVisitCounts(&visit_counts);
+  EXPECT_THAT(visit_counts, ::testing::ContainerEq(expected_counts));
+}
+
 #define EXPECT_LINES_VISITED(line_info, ...) \
     { \
       const size_t kLineNumbers[] = { __VA_ARGS__ }; \
@@ -208,4 +258,62 @@ TEST_F(LineInfoTest, VisitCounterWorks) {
   EXPECT_EQ(0xffffffff, line_it->visit_count);
 }
 
+TEST_F(LineInfoTest, VisitRanges) {
+  std::string source_file("foo.cc");
+  TestLineInfo expected;
+  TestLineInfo line_info;
+  InitSyntheticLines(50, &source_file, &expected);
+  InitSyntheticLines(50, &source_file, &line_info);
+
+  // Overlapping, repeated, empty and gap spanning ranges, in address order.
+  LineInfo::VisitedRanges ranges;
+  ranges.push_back(LineInfo::VisitedRange(core::RelativeAddress(4000), 97, 1));
+  ranges.push_back(LineInfo::VisitedRange(core::RelativeAddress(4096), 2, 3));
+  ranges.push_back(LineInfo::VisitedRange(core::RelativeAddress(4096), 0, 5));
+  ranges.push_back(LineInfo::VisitedRange(core::RelativeAddress(4097), 40, 2));
+  ranges.push_back(LineInfo::VisitedRange(core::RelativeAddress(4100), 1, 1));
+  ranges.push_back(LineInfo::VisitedRange(core::RelativeAddress(4150), 7, 4));
+  ranges.push_back(LineInfo::VisitedRange(core::RelativeAddress(4151), 1, 1));
+  ranges.push_back(LineInfo::VisitedRange(core::RelativeAddress(4200), 3,
+                                          0xFFFFFFFF));
+  ranges.push_back(LineInfo::VisitedRange(core::RelativeAddress(4200), 3, 1));
+  ranges.push_back(LineInfo::VisitedRange(core::RelativeAddress(4290), 50, 1));
+  ranges.push_back(LineInfo::VisitedRange(core::RelativeAddress(9000), 2, 1));
+
+  ExpectVisitRangesMatchesVisit(ranges, 0, &expected, &line_info);
+}
+
+TEST_F(LineInfoTest, VisitRangesFailsOnUnsortedRanges) {
+  std::string source_file("foo.cc");
+  TestLineInfo line_info;
+  InitSyntheticLines(10, &source_file, &line_info);
+
+  LineInfo::VisitedRanges ranges;
+  ranges.push_back(LineInfo::VisitedRange(core::RelativeAddress(4100), 2, 1));
+  ranges.push_back(LineInfo::VisitedRange(core::RelativeAddress(4096), 2, 1));
+  EXPECT_FALSE(line_info.VisitRanges(ranges));
+  EXPECT_FALSE(line_info.VisitRanges(ranges, 4));
+  EXPECT_NO_LINES_VISITED(line_info);
+}
+
+TEST_F(LineInfoTest, ParallelVisitRanges) {
+  std::string source_file("foo.cc");
+  TestLineInfo expected;
+  TestLineInfo line_info;
+  InitSyntheticLines(1000, &source_file, &expected);
+  InitSyntheticLines(1000, &source_file, &line_info);
+
+  // Ranges of varied sizes, some of which straddle the partitions of the
+  // source lines.
+  LineInfo::VisitedRanges ranges;
+  for (uint32 address = 4000; address < 9000; address += 13) {
+    size_t size = (address * 7) % 31;
+    ranges.push_back(
+        LineInfo::VisitedRange(core::RelativeAddress(address), size, 1));
+  }
+  ranges.push_back(LineInfo::VisitedRange(core::RelativeAddress(9000), 500, 2));
+
+  ExpectVisitRangesMatchesVisit(ranges, 4, &expected, &line_info);
+}
+
 }  // namespace grinder
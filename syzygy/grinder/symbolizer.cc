@@ -0,0 +1,562 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/grinder/symbolizer.h"
+
+#include <dia2.h>
+
+#include <algorithm>
+
+#include "base/environment.h"
+#include "base/file_util.h"
+#include "base/logging.h"
+#include "base/stringprintf.h"
+#include "base/sys_info.h"
+#include "base/utf_string_conversions.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/memory/scoped_vector.h"
+#include "base/threading/simple_thread.h"
+#include "base/win/scoped_bstr.h"
+#include "base/win/scoped_com_initializer.h"
+#include "base/win/scoped_comptr.h"
+#include "sawbuck/common/com_utils.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/pdb/pdb_util.h"
+#include "syzygy/pe/find.h"
+
+namespace grinder {
+
+namespace {
+
+using base::win::ScopedBstr;
+using base::win::ScopedComPtr;
+
+typedef Symbolizer::ModuleInformation ModuleInformation;
+typedef Symbolizer::RVA RVA;
+typedef Symbolizer::Symbol Symbol;
+typedef Symbolizer::SymbolMap SymbolMap;
+typedef std::set<RVA> RVASet;
+
+// The extension used for cache entries.
+const wchar_t kCacheEntryExtension[] = L".sym";
+
+// The version of the cache entry format. This must be incremented whenever
+// the format changes.
+const uint32 kCacheEntryVersion = 1;
+
+// Builds the path of the symbol cache entry for a module.
+// @param cache_dir the directory housing the cache entries.
+// @param module_path the path to the module.
+// @param entry_path on success returns the path to the cache entry.
+// @returns true on success, false if the PDB of the module can't be found.
+bool GetCacheEntryPath(const base::FilePath& cache_dir,
+                       const base::FilePath& module_path,
+                       base::FilePath* entry_path) {
+  DCHECK(entry_path != NULL);
+
+  base::FilePath pdb_path;
+  if (!pe::FindPdbForModule(module_path, &pdb_path) || pdb_path.empty())
+    return false;
+
+  pdb::PdbInfoHeader70 pdb_header = {};
+  if (!pdb::ReadPdbHeader(pdb_path, &pdb_header)) {
+    LOG(ERROR) << "Unable to read PDB info header from PDB file: "
+               << pdb_path.value();
+    return false;
+  }
+
+  // The entries are keyed on the GUID and age of the PDB, which identify a
+  // build. Prefix the key with the module name to make the cache easier to
+  // inspect.
+  const GUID& guid = pdb_header.signature;
+  std::wstring name = base::StringPrintf(
+      L"%ls-%08X%04X%04X%02X%02X%02X%02X%02X%02X%02X%02X%X%ls",
+      module_path.BaseName().value().c_str(),
+      guid.Data1, guid.Data2, guid.Data3,
+      guid.Data4[0], guid.Data4[1], guid.Data4[2], guid.Data4[3],
+      guid.Data4[4], guid.Data4[5], guid.Data4[6], guid.Data4[7],
+      pdb_header.pdb_age,
+      kCacheEntryExtension);
+  *entry_path = cache_dir.Append(name);
+
+  return true;
+}
+
+// Loads a symbol cache entry.
+// @param entry_path the path to the cache entry.
+// @param symbols receives the symbols held by the entry.
+// @returns true on success, false if there is no usable entry.
+bool LoadCacheEntry(const base::FilePath& entry_path, SymbolMap* symbols) {
+  DCHECK(symbols != NULL);
+
+  if (!file_util::PathExists(entry_path))
+    return false;
+
+  {
+    file_util::ScopedFILE in_file(file_util::OpenFile(entry_path, "rb"));
+    if (in_file.get() != NULL) {
+      core::FileInStream in_stream(in_file.get());
+      core::NativeBinaryInArchive in_archive(&in_stream);
+      uint32 version = 0;
+      if (in_archive.Load(&version) && version == kCacheEntryVersion &&
+          in_archive.Load(symbols)) {
+        return true;
+      }
+    }
+  }
+
+  // The entry is unusable, so get rid of it. This way it gets replaced.
+  LOG(WARNING) << "Unable to load symbol cache entry \""
+               << entry_path.value() << "\", deleting it.";
+  file_util::Delete(entry_path, false);
+  symbols->clear();
+  return false;
+}
+
+// Saves a symbol cache entry. The entry is written to a temporary file and
+// then moved into place, so concurrent users of the cache never observe a
+// partially written entry.
+// @param entry_path the path to the cache entry.
+// @param symbols the symbols to save.
+// @returns true on success, false on failure.
+bool SaveCacheEntry(const base::FilePath& entry_path,
+                    const SymbolMap& symbols) {
+  base::FilePath cache_dir = entry_path.DirName();
+  if (!file_util::CreateDirectory(cache_dir)) {
+    LOG(ERROR) << "Unable to create symbol cache directory \""
+               << cache_dir.value() << "\".";
+    return false;
+  }
+
+  base::FilePath temp_path;
+  if (!file_util::CreateTemporaryFileInDir(cache_dir, &temp_path)) {
+    LOG(ERROR) << "Unable to create a temporary file in \""
+               << cache_dir.value() << "\".";
+    return false;
+  }
+
+  bool saved = false;
+  {
+    file_util::ScopedFILE out_file(file_util::OpenFile(temp_path, "wb"));
+    if (out_file.get() != NULL) {
+      core::FileOutStream out_stream(out_file.get());
+      core::NativeBinaryOutArchive out_archive(&out_stream);
+      saved = out_archive.Save(kCacheEntryVersion) &&
+          out_archive.Save(symbols) &&
+          out_archive.Flush();
+    }
+  }
+
+  if (!saved) {
+    LOG(ERROR) << "Unable to write symbol cache entry \""
+               << temp_path.value() << "\".";
+    file_util::Delete(temp_path, false);
+    return false;
+  }
+
+  // Another process may have populated the entry in the meantime. Either
+  // copy is as good as the other.
+  if (!file_util::Move(temp_path, entry_path)) {
+    file_util::Delete(temp_path, false);
+    if (!file_util::PathExists(entry_path)) {
+      LOG(ERROR) << "Unable to move symbol cache entry into place at \""
+                 << entry_path.value() << "\".";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Opens a symbol session for a module.
+// @param module_path the path to the module.
+// @param session_out on success returns the symbol session.
+// @returns true on success, false on failure.
+bool CreateSessionForModule(const base::FilePath& module_path,
+                            IDiaSession** session_out) {
+  DCHECK(session_out != NULL);
+  DCHECK(*session_out == NULL);
+
+  ScopedComPtr<IDiaDataSource> source;
+  HRESULT hr = source.CreateInstance(CLSID_DiaSource);
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failed to create DiaSource: " << com::LogHr(hr) << ".";
+    return false;
+  }
+
+  ScopedComPtr<IDiaSession> new_session;
+  // We first try loading straight-up for the module. If the module is at
+  // this path and the symsrv machinery is available, this will bring that
+  // machinery to bear.
+  // The downside is that if the module at this path does not match the
+  // original module, we may load the wrong symbol information for the
+  // module.
+  hr = source->loadDataForExe(module_path.value().c_str(), NULL, NULL);
+  if (SUCCEEDED(hr)) {
+    hr = source->openSession(new_session.Receive());
+    if (FAILED(hr))
+      LOG(ERROR) << "Failure in openSession: " << com::LogHr(hr) << ".";
+  } else {
+    DCHECK(FAILED(hr));
+
+    base::FilePath pdb_path;
+    if (!pe::FindPdbForModule(module_path, &pdb_path) ||
+        pdb_path.empty()) {
+      LOG(ERROR) << "Unable to find PDB for module \""
+                 << module_path.value() << "\".";
+    }
+
+    hr = source->loadDataFromPdb(pdb_path.value().c_str());
+    if (SUCCEEDED(hr)) {
+      hr = source->openSession(new_session.Receive());
+      if (FAILED(hr))
+        LOG(ERROR) << "Failure in openSession: " << com::LogHr(hr) << ".";
+    } else {
+      LOG(WARNING) << "Failure in loadDataFromPdb('"
+                   << module_path.value().c_str() << "'): "
+                   << com::LogHr(hr) << ".";
+    }
+  }
+
+  DCHECK((SUCCEEDED(hr) && new_session.get() != NULL) ||
+         (FAILED(hr) && new_session.get() == NULL));
+  if (new_session.get() == NULL)
+    return false;
+
+  *session_out = new_session.Detach();
+  return true;
+}
+
+// Retrieves the function containing @p address.
+// @param symbol on success returns the function's private symbol, or
+//     public symbol if no private symbol is available.
+// @returns true on success.
+bool GetFunctionSymbolByRVA(IDiaSession* session,
+                            RVA address,
+                            IDiaSymbol** symbol) {
+  DCHECK(session != NULL);
+  DCHECK(symbol != NULL && *symbol == NULL);
+
+  ScopedComPtr<IDiaSymbol> function;
+  HRESULT hr = session->findSymbolByRVA(address,
+                                        SymTagFunction,
+                                        function.Receive());
+  if (FAILED(hr) || function.get() == NULL) {
+    // No private function, let's try for a public symbol.
+    hr = session->findSymbolByRVA(address,
+                                  SymTagPublicSymbol,
+                                  function.Receive());
+    if (FAILED(hr))
+      return false;
+  }
+  if (function.get() == NULL) {
+    LOG(ERROR) << "NULL function returned from findSymbolByRVA.";
+    return false;
+  }
+
+  *symbol = function.Detach();
+
+  return true;
+}
+
+// Symbolizes a single address.
+// @param session the symbol session of the module containing the address.
+// @param rva the address to symbolize.
+// @param symbol on success returns the symbol of the address.
+// @returns true on success, false on failure.
+bool SymbolizeRVA(IDiaSession* session, RVA rva, Symbol* symbol) {
+  DCHECK(session != NULL);
+  DCHECK(symbol != NULL);
+
+  ScopedComPtr<IDiaSymbol> function_sym;
+  if (!GetFunctionSymbolByRVA(session, rva, function_sym.Receive()))
+    return false;
+
+  DWORD function_rva = 0;
+  HRESULT hr = function_sym->get_relativeVirtualAddress(&function_rva);
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failure in get_relativeVirtualAddress: "
+               << com::LogHr(hr) << ".";
+    return false;
+  }
+
+  ScopedBstr function_name_bstr;
+  hr = function_sym->get_name(function_name_bstr.Receive());
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failure in get_name: " << com::LogHr(hr) << ".";
+    return false;
+  }
+
+  ULONGLONG length = 0;
+  hr = function_sym->get_length(&length);
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failure in get_length: " << com::LogHr(hr) << ".";
+    return false;
+  }
+
+  symbol->function_rva = function_rva;
+  symbol->function_name = com::ToString(function_name_bstr);
+  symbol->file_name.clear();
+  symbol->line = 0;
+  if (length == 0)
+    return true;
+
+  // Look up the first line at the address.
+  ScopedComPtr<IDiaEnumLineNumbers> enum_lines;
+  hr = session->findLinesByRVA(rva, length, enum_lines.Receive());
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failure in findLinesByRVA: " << com::LogHr(hr) << ".";
+    return false;
+  }
+
+  ScopedComPtr<IDiaLineNumber> line;
+  ULONG fetched = 0;
+  hr = enum_lines->Next(1, line.Receive(), &fetched);
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failure in IDiaLineNumber::Next: " << com::LogHr(hr) << ".";
+    return false;
+  }
+  if (fetched == 0)
+    return true;
+  DCHECK_EQ(1U, fetched);
+
+  DWORD line_number = 0;
+  hr = line->get_lineNumber(&line_number);
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failure in get_lineNumber: " << com::LogHr(hr) << ".";
+    return false;
+  }
+  ScopedComPtr<IDiaSourceFile> source_file;
+  hr = line->get_sourceFile(source_file.Receive());
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failure in get_sourceFile: " << com::LogHr(hr) << ".";
+    return false;
+  }
+  ScopedBstr file_name_bstr;
+  hr = source_file->get_fileName(file_name_bstr.Receive());
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failure in get_fileName: " << com::LogHr(hr) << ".";
+    return false;
+  }
+
+  symbol->file_name = com::ToString(file_name_bstr);
+  symbol->line = line_number;
+  return true;
+}
+
+// Symbolizes the queued addresses of a single module. This uses a symbol
+// session of its own, so that modules can be symbolized in parallel.
+class SymbolizeWorker : public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param module the module to symbolize.
+  // @param rvas the addresses to symbolize.
+  // @param cache_dir the symbol cache directory, or an empty path.
+  // @param symbols receives the symbols of @p rvas.
+  SymbolizeWorker(const ModuleInformation* module,
+                  const RVASet* rvas,
+                  const base::FilePath& cache_dir,
+                  SymbolMap* symbols)
+      : module_(module), rvas_(rvas), cache_dir_(cache_dir),
+        symbols_(symbols) {
+    DCHECK(module != NULL);
+    DCHECK(rvas != NULL);
+    DCHECK(symbols != NULL);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  virtual void Run() OVERRIDE;
+  // @}
+
+ private:
+  // Gives all of the addresses not yet symbolized an invalid symbol.
+  void AddInvalidSymbols();
+
+  const ModuleInformation* module_;
+  const RVASet* rvas_;
+  base::FilePath cache_dir_;
+  SymbolMap* symbols_;
+
+  DISALLOW_COPY_AND_ASSIGN(SymbolizeWorker);
+};
+
+void SymbolizeWorker::Run() {
+  pe::PEFile::Signature signature;
+  signature.path = module_->image_file_name;
+  signature.base_address = core::AbsoluteAddress(
+      static_cast<uint32>(module_->base_address));
+  signature.module_size = module_->module_size;
+  signature.module_time_date_stamp = module_->time_date_stamp;
+  signature.module_checksum = module_->image_checksum;
+
+  base::FilePath module_path;
+  if (!pe::FindModuleBySignature(signature, &module_path) ||
+      module_path.empty()) {
+    LOG(ERROR) << "Unable to find module matching signature of \""
+               << module_->image_file_name << "\".";
+    AddInvalidSymbols();
+    return;
+  }
+
+  // Take what we can from the cache.
+  base::FilePath entry_path;
+  SymbolMap cached_symbols;
+  if (!cache_dir_.empty() &&
+      GetCacheEntryPath(cache_dir_, module_path, &entry_path)) {
+    LoadCacheEntry(entry_path, &cached_symbols);
+  }
+
+  RVASet missing_rvas;
+  RVASet::const_iterator rva_it = rvas_->begin();
+  for (; rva_it != rvas_->end(); ++rva_it) {
+    SymbolMap::const_iterator cached_it = cached_symbols.find(*rva_it);
+    if (cached_it != cached_symbols.end())
+      symbols_->insert(*cached_it);
+    else
+      missing_rvas.insert(*rva_it);
+  }
+  if (missing_rvas.empty())
+    return;
+
+  // DIA is accessed through COM, which must be initialized on each thread.
+  base::win::ScopedCOMInitializer com_initializer;
+
+  ScopedComPtr<IDiaSession> session;
+  if (!CreateSessionForModule(module_path, session.Receive())) {
+    AddInvalidSymbols();
+    return;
+  }
+
+  size_t num_unresolved = 0;
+  for (rva_it = missing_rvas.begin(); rva_it != missing_rvas.end(); ++rva_it) {
+    Symbol symbol;
+    if (!SymbolizeRVA(session.get(), *rva_it, &symbol)) {
+      // Remember the address as one that can't be symbolized.
+      symbol = Symbol();
+      ++num_unresolved;
+    }
+    symbols_->insert(std::make_pair(*rva_it, symbol));
+    cached_symbols.insert(std::make_pair(*rva_it, symbol));
+  }
+
+  if (num_unresolved != 0) {
+    LOG(WARNING) << "No symbol info available for " << num_unresolved
+                 << " addresses in module '" << module_->image_file_name
+                 << "'.";
+  }
+
+  if (!entry_path.empty())
+    SaveCacheEntry(entry_path, cached_symbols);
+}
+
+void SymbolizeWorker::AddInvalidSymbols() {
+  RVASet::const_iterator rva_it = rvas_->begin();
+  for (; rva_it != rvas_->end(); ++rva_it)
+    symbols_->insert(std::make_pair(*rva_it, Symbol()));
+}
+
+}  // namespace
+
+const char Symbolizer::kCacheDirEnvVar[] = "SYZYGY_SYMBOL_CACHE_DIR";
+
+bool Symbolizer::ModuleSignatureLess::operator()(
+    const ModuleInformation& a, const ModuleInformation& b) const {
+  if (a.module_size != b.module_size)
+    return a.module_size < b.module_size;
+  if (a.image_checksum != b.image_checksum)
+    return a.image_checksum < b.image_checksum;
+  if (a.time_date_stamp != b.time_date_stamp)
+    return a.time_date_stamp < b.time_date_stamp;
+  return a.image_file_name < b.image_file_name;
+}
+
+Symbolizer::Symbolizer()
+    : num_threads_(base::SysInfo::NumberOfProcessors()) {
+}
+
+Symbolizer::~Symbolizer() {
+}
+
+void Symbolizer::GetCacheDirFromEnvironment(base::FilePath* cache_dir) {
+  DCHECK(cache_dir != NULL);
+
+  *cache_dir = base::FilePath();
+
+  scoped_ptr<base::Environment> env(base::Environment::Create());
+  CHECK(env != NULL);
+  std::string value;
+  if (!env->GetVar(kCacheDirEnvVar, &value) || value.empty())
+    return;
+
+  *cache_dir = base::FilePath(UTF8ToWide(value));
+}
+
+void Symbolizer::set_num_threads(size_t num_threads) {
+  num_threads_ = std::max(num_threads, static_cast<size_t>(1));
+}
+
+void Symbolizer::AddRVA(const ModuleInformation& module, RVA rva) {
+  ModuleSymbols& module_symbols = modules_[module];
+  if (module_symbols.symbols.find(rva) == module_symbols.symbols.end())
+    module_symbols.pending_rvas.insert(rva);
+}
+
+bool Symbolizer::Resolve() {
+  ScopedVector<SymbolizeWorker> workers;
+  ModuleSymbolsMap::iterator module_it = modules_.begin();
+  for (; module_it != modules_.end(); ++module_it) {
+    ModuleSymbols& module_symbols = module_it->second;
+    if (module_symbols.pending_rvas.empty())
+      continue;
+
+    workers.push_back(new SymbolizeWorker(&module_it->first,
+                                          &module_symbols.pending_rvas,
+                                          cache_dir_,
+                                          &module_symbols.symbols));
+  }
+
+  if (workers.empty())
+    return true;
+
+  // Each worker only touches the symbols of its own module.
+  size_t num_threads = std::min(num_threads_, workers.size());
+  base::DelegateSimpleThreadPool pool("Symbolizer",
+                                      static_cast<int>(num_threads));
+  pool.Start();
+  for (size_t i = 0; i < workers.size(); ++i)
+    pool.AddWork(workers[i]);
+  pool.JoinAll();
+
+  for (module_it = modules_.begin(); module_it != modules_.end(); ++module_it)
+    module_it->second.pending_rvas.clear();
+
+  return true;
+}
+
+const Symbolizer::Symbol* Symbolizer::FindSymbol(
+    const ModuleInformation& module, RVA rva) const {
+  ModuleSymbolsMap::const_iterator module_it = modules_.find(module);
+  if (module_it == modules_.end())
+    return NULL;
+
+  SymbolMap::const_iterator symbol_it = module_it->second.symbols.find(rva);
+  if (symbol_it == module_it->second.symbols.end() ||
+      !symbol_it->second.IsValid()) {
+    return NULL;
+  }
+
+  return &symbol_it->second;
+}
+
+}  // namespace grinder
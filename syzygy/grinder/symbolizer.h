@@ -0,0 +1,153 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares Symbolizer, which resolves batches of addresses in the modules
+// seen by the grinders to their functions and source lines. The modules are
+// symbolized in parallel, and the results can be kept in an on-disk cache so
+// that grinding traces of the same build again needs no symbol lookups.
+
+#ifndef SYZYGY_GRINDER_SYMBOLIZER_H_
+#define SYZYGY_GRINDER_SYMBOLIZER_H_
+
+#include <map>
+#include <set>
+#include <string>
+
+#include "base/files/file_path.h"
+#include "sawbuck/sym_util/types.h"
+
+namespace grinder {
+
+class Symbolizer {
+ public:
+  typedef sym_util::ModuleInformation ModuleInformation;
+  typedef uint32 RVA;
+
+  // The symbol information resolved for an address.
+  struct Symbol {
+    Symbol() : function_rva(0), line(0) {
+    }
+
+    // @returns true if the address was symbolized.
+    bool IsValid() const { return !function_name.empty(); }
+
+    // @name Serialization functions.
+    // @{
+    template<class OutArchive> bool Save(OutArchive* out_archive) const {
+      return out_archive->Save(function_rva) &&
+          out_archive->Save(function_name) &&
+          out_archive->Save(file_name) &&
+          out_archive->Save(static_cast<uint32>(line));
+    }
+    template<class InArchive> bool Load(InArchive* in_archive) {
+      uint32 line_number = 0;
+      if (!in_archive->Load(&function_rva) ||
+          !in_archive->Load(&function_name) ||
+          !in_archive->Load(&file_name) ||
+          !in_archive->Load(&line_number)) {
+        return false;
+      }
+      line = line_number;
+      return true;
+    }
+    // @}
+
+    // The address of the function containing the address. For addresses that
+    // couldn't be symbolized, the function name is empty. These are kept so
+    // that the cache remembers them.
+    RVA function_rva;
+    std::wstring function_name;
+    // The source file and line number of the address, if available.
+    std::wstring file_name;
+    size_t line;
+  };
+
+  // The symbols of a module, by address.
+  typedef std::map<RVA, Symbol> SymbolMap;
+
+  // The name of the environment variable that may be used to specify a
+  // symbol cache directory to the grinders.
+  static const char kCacheDirEnvVar[];
+
+  Symbolizer();
+  ~Symbolizer();
+
+  // Gets the cache directory specified in the environment, if any.
+  // @param cache_dir will receive the cache directory. This is left empty if
+  //     the environment does not specify a cache directory.
+  static void GetCacheDirFromEnvironment(base::FilePath* cache_dir);
+
+  // @name Accessors and mutators.
+  // @{
+  // The number of modules that are symbolized concurrently. Defaults to the
+  // number of processors.
+  size_t num_threads() const { return num_threads_; }
+  void set_num_threads(size_t num_threads);
+  // The directory housing the symbol cache entries. If this is empty, which
+  // is the default, symbols aren't cached.
+  const base::FilePath& cache_dir() const { return cache_dir_; }
+  void set_cache_dir(const base::FilePath& cache_dir) {
+    cache_dir_ = cache_dir;
+  }
+  // @}
+
+  // Queues an address to be symbolized by the next call to Resolve.
+  // @param module the module containing the address. Modules are identified
+  //     by their signature, so a module loaded at different addresses, or in
+  //     different processes, is only symbolized once.
+  // @param rva the address to symbolize, relative to the module.
+  void AddRVA(const ModuleInformation& module, RVA rva);
+
+  // Symbolizes all of the queued addresses. The modules are symbolized in
+  // parallel, each through a symbol session of its own.
+  // @returns true on success, false on failure. Addresses that can't be
+  //     symbolized don't cause a failure, but have no symbol.
+  bool Resolve();
+
+  // Looks up the symbol of an address symbolized by Resolve.
+  // @param module the module containing the address.
+  // @param rva the address, relative to the module.
+  // @returns the symbol of the address, or NULL if it has none.
+  const Symbol* FindSymbol(const ModuleInformation& module, RVA rva) const;
+
+ protected:
+  // Compares module information without regard to base address.
+  struct ModuleSignatureLess {
+    bool operator()(const ModuleInformation& a,
+                    const ModuleInformation& b) const;
+  };
+
+  // The addresses of a module that have been queued, and those that have
+  // been symbolized.
+  struct ModuleSymbols {
+    std::set<RVA> pending_rvas;
+    SymbolMap symbols;
+  };
+
+  typedef std::map<ModuleInformation, ModuleSymbols, ModuleSignatureLess>
+      ModuleSymbolsMap;
+
+  // The modules seen so far.
+  ModuleSymbolsMap modules_;
+
+  size_t num_threads_;
+  base::FilePath cache_dir_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(Symbolizer);
+};
+
+}  // namespace grinder
+
+#endif  // SYZYGY_GRINDER_SYMBOLIZER_H_
@@ -0,0 +1,127 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/grinder/symbolizer.h"
+
+#include "base/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/pe/pe_file.h"
+#include "syzygy/pe/unittest_util.h"
+
+namespace grinder {
+
+namespace {
+
+class SymbolizerTest : public testing::PELibUnitTest {
+ public:
+  virtual void SetUp() OVERRIDE {
+    testing::PELibUnitTest::SetUp();
+
+    base::FilePath test_dll_path =
+        testing::GetExeRelativePath(testing::kTestDllName);
+    pe::PEFile pe_file;
+    ASSERT_TRUE(pe_file.Init(test_dll_path));
+
+    pe::PEFile::Signature signature;
+    pe_file.GetSignature(&signature);
+    module_.base_address = signature.base_address.value();
+    module_.module_size = signature.module_size;
+    module_.image_checksum = signature.module_checksum;
+    module_.time_date_stamp = signature.module_time_date_stamp;
+    module_.image_file_name = signature.path;
+
+    // The entry point is a function of its own.
+    entry_point_ = pe_file.nt_headers()->OptionalHeader.AddressOfEntryPoint;
+  }
+
+  void ExpectEntryPointSymbol(const Symbolizer& symbolizer) {
+    const Symbolizer::Symbol* symbol =
+        symbolizer.FindSymbol(module_, entry_point_);
+    ASSERT_TRUE(symbol != NULL);
+    EXPECT_EQ(entry_point_, symbol->function_rva);
+    EXPECT_FALSE(symbol->function_name.empty());
+  }
+
+  Symbolizer::ModuleInformation module_;
+  Symbolizer::RVA entry_point_;
+};
+
+}  // namespace
+
+TEST_F(SymbolizerTest, SetNumThreads) {
+  Symbolizer symbolizer;
+  EXPECT_LE(1U, symbolizer.num_threads());
+
+  symbolizer.set_num_threads(3);
+  EXPECT_EQ(3U, symbolizer.num_threads());
+  symbolizer.set_num_threads(0);
+  EXPECT_EQ(1U, symbolizer.num_threads());
+}
+
+TEST_F(SymbolizerTest, FindSymbolFailsForUnknownAddress) {
+  Symbolizer symbolizer;
+  EXPECT_TRUE(symbolizer.FindSymbol(module_, entry_point_) == NULL);
+
+  // Resolving without any queued address succeeds trivially.
+  EXPECT_TRUE(symbolizer.Resolve());
+  EXPECT_TRUE(symbolizer.FindSymbol(module_, entry_point_) == NULL);
+}
+
+TEST_F(SymbolizerTest, Resolve) {
+  Symbolizer symbolizer;
+  symbolizer.AddRVA(module_, entry_point_);
+  ASSERT_TRUE(symbolizer.Resolve());
+  ASSERT_NO_FATAL_FAILURE(ExpectEntryPointSymbol(symbolizer));
+
+  // The same module loaded at a different address shares its symbols.
+  Symbolizer::ModuleInformation rebased_module = module_;
+  rebased_module.base_address += 0x100000;
+  EXPECT_EQ(symbolizer.FindSymbol(module_, entry_point_),
+            symbolizer.FindSymbol(rebased_module, entry_point_));
+}
+
+TEST_F(SymbolizerTest, ResolveUsesCache) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath cache_dir = temp_dir.path().Append(L"cache");
+
+  Symbolizer symbolizer;
+  symbolizer.set_cache_dir(cache_dir);
+  symbolizer.AddRVA(module_, entry_point_);
+  ASSERT_TRUE(symbolizer.Resolve());
+  ASSERT_NO_FATAL_FAILURE(ExpectEntryPointSymbol(symbolizer));
+
+  // A single cache entry has been written for the module.
+  file_util::FileEnumerator enumerator(cache_dir, false,
+                                       file_util::FileEnumerator::FILES);
+  base::FilePath entry_path = enumerator.Next();
+  ASSERT_FALSE(entry_path.empty());
+  EXPECT_TRUE(enumerator.Next().empty());
+  int64 entry_size = 0;
+  ASSERT_TRUE(file_util::GetFileSize(entry_path, &entry_size));
+  EXPECT_LT(0, entry_size);
+
+  // Another symbolizer gets the same symbol from the cache.
+  Symbolizer cached_symbolizer;
+  cached_symbolizer.set_cache_dir(cache_dir);
+  cached_symbolizer.AddRVA(module_, entry_point_);
+  ASSERT_TRUE(cached_symbolizer.Resolve());
+  ASSERT_NO_FATAL_FAILURE(ExpectEntryPointSymbol(cached_symbolizer));
+  EXPECT_EQ(symbolizer.FindSymbol(module_, entry_point_)->function_name,
+            cached_symbolizer.FindSymbol(module_, entry_point_)->function_name);
+}
+
+}  // namespace grinder
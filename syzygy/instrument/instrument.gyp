@@ -66,6 +66,8 @@
         '<(src)/syzygy/block_graph/transforms/block_graph_transforms.gyp:'
             'block_graph_transforms_lib',
         '<(src)/syzygy/common/common.gyp:common_lib',
+        '<(src)/syzygy/common/common.gyp:stage_profiler_lib',
+        '<(src)/syzygy/grinder/grinder.gyp:grinder_lib',
         '<(src)/syzygy/pe/orderers/pe_orderers.gyp:pe_orderers_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
         '<(src)/syzygy/pe/transforms/pe_transforms.gyp:pe_transforms_lib',
@@ -128,6 +130,7 @@
         '<(src)/syzygy/pe/pe.gyp:pe_unittest_utils',
         '<(src)/syzygy/pe/pe.gyp:test_dll',
         '<(src)/syzygy/test_data/test_data.gyp:asan_instrumented_test_dll',
+        '<(src)/syzygy/test_data/test_data.gyp:basic_block_entry_counts',
       ],
     },
   ],
@@ -20,8 +20,20 @@
 #include <algorithm>
 #include <iostream>
 
+#include "base/bind.h"
+#include "base/file_util.h"
+#include "base/string_number_conversions.h"
 #include "base/string_util.h"
 #include "base/stringprintf.h"
+#include "base/utf_string_conversions.h"
+#include "base/values.h"
+#include "base/json/json_reader.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/strings/string_split.h"
+#include "base/threading/simple_thread.h"
+#include "base/win/scoped_com_initializer.h"
+#include "syzygy/common/stage_profiler.h"
+#include "syzygy/core/closure_delegate.h"
 #include "syzygy/instrument/instrumenters/asan_instrumenter.h"
 #include "syzygy/instrument/instrumenters/bbentry_instrumenter.h"
 #include "syzygy/instrument/instrumenters/branch_instrumenter.h"
@@ -33,6 +45,17 @@ namespace instrument {
 
 namespace {
 
+using base::DictionaryValue;
+using base::ListValue;
+using base::Value;
+
+// The keys of a batch manifest entry.
+const char kInputImageKey[] = "input_image";
+const char kOutputImageKey[] = "output_image";
+const char kInputPdbKey[] = "input_pdb";
+const char kOutputPdbKey[] = "output_pdb";
+const char kFilterKey[] = "filter";
+
 static const char kUsageFormatStr[] =
     "Usage: %ls [options]\n"
     "  Required arguments:\n"
@@ -44,6 +67,30 @@ static const char kUsageFormatStr[] =
     "                            (this default behaviour is DEPRECATED).\n"
     "    --output-image=<path>\n"
     "                            The instrumented output image.\n"
+    "  Batch mode options:\n"
+    "    --manifest=<path>       Instrument all the images listed in this\n"
+    "                            JSON file, instead of --input-image and\n"
+    "                            --output-image. It contains a list of\n"
+    "                            dictionaries with input_image and\n"
+    "                            output_image paths, and optional input_pdb,\n"
+    "                            output_pdb and filter paths, relative to\n"
+    "                            the manifest. All other options apply to\n"
+    "                            every image.\n"
+    "    --object-list=<path>    Instrument all the COFF object files listed\n"
+    "                            in this file, one path per line relative to\n"
+    "                            it, instead of --input-image and\n"
+    "                            --output-image. They are relinked together\n"
+    "                            in this process and written under their own\n"
+    "                            names to --output-dir. Blank lines and lines\n"
+    "                            starting with # are ignored.\n"
+    "    --output-dir=<path>     The directory the instrumented object files\n"
+    "                            are written to. Required by --object-list.\n"
+    "    --batch-threads=<n>     The number of images to instrument\n"
+    "                            concurrently. Each one is held in memory\n"
+    "                            until it has been written, so this bounds\n"
+    "                            the memory used. Defaults to 1 with\n"
+    "                            --manifest, and to the number of processors\n"
+    "                            with --object-list.\n"
     "  DEPRECATED options:\n"
     "    --input-dll is aliased to --input-image.\n"
     "    --output-dll is aliased to --output-image.\n"
@@ -64,7 +111,11 @@ static const char kUsageFormatStr[] =
     "                            function's name. This is at the cost of the\n"
     "                            uniqueness of address->name resolution.\n"
     "    --inline-fast-path      Inline a fast path into the instrumented\n"
-    "                            image.\n"
+    "                            image. In asan mode this inlines the test of\n"
+    "                            the shadow byte of the accesses performed\n"
+    "                            while the flags are dead. Not supported for\n"
+    "                            code running before the imports are\n"
+    "                            resolved, e.g. under the Chrome sandbox.\n"
     "    --input-pdb=<path>      The PDB for the DLL to instrument. If not\n"
     "                            explicitly provided will be searched for.\n"
     "    --filter=<path>         The path of the filter to be used in\n"
@@ -84,7 +135,40 @@ static const char kUsageFormatStr[] =
     "    --output-pdb=<path>     The PDB for the instrumented DLL. If not\n"
     "                            provided will attempt to generate one.\n"
     "    --overwrite             Allow output files to be overwritten.\n"
+    "    --profile-output=<path> Write the time spent in, and the memory used\n"
+    "                            by, each stage of the instrumenter to this\n"
+    "                            JSON file.\n"
     "  asan mode options:\n"
+    "    --count-checks          Counts the executions of each memory access\n"
+    "                            check with the basic-block entry agent.\n"
+    "                            Grinding the traces in bbentry mode gives\n"
+    "                            the counts by checked instruction.\n"
+    "    --decomposition-threads=<n>\n"
+    "                            The number of threads on which to basic-\n"
+    "                            block decompose functions concurrently.\n"
+    "                            Defaults to 1.\n"
+    "    --hoist-invariant-checks\n"
+    "                            Hoists the checks of loop-invariant memory\n"
+    "                            accesses out of their loops. Has no effect\n"
+    "                            with --no-redundancy-analysis.\n"
+    "    --inline-filter=<path>  The path of a filter marking the ranges the\n"
+    "                            fast path is inlined into. Implies\n"
+    "                            --inline-fast-path.\n"
+    "    --instrumentation-rate=<r>\n"
+    "                            The fraction of the memory accesses to\n"
+    "                            instrument, in [0, 1]. Defaults to 1.\n"
+    "    --instrumentation-seed=<n>\n"
+    "                            The seed selecting the memory accesses that\n"
+    "                            are instrumented when the rate is below 1.\n"
+    "                            Defaults to 0.\n"
+    "    --hot-block-entry-counts=<path>\n"
+    "                            The basic-block entry counts of the input\n"
+    "                            module, as generated by grinder in bbentry\n"
+    "                            mode. The hottest basic blocks get the\n"
+    "                            cheapest checks.\n"
+    "    --hot-block-percent=<n>\n"
+    "                            The percentage of the entered basic blocks\n"
+    "                            that are considered hot. Defaults to 10.\n"
     "    --no-crt-interceptors\n"
     "                            Disable the interception of the CRT\n"
     "                            functions like memset, memcpy, stcpy... to\n"
@@ -93,10 +177,26 @@ static const char kUsageFormatStr[] =
     "                            analysis.\n"
     "    --no-redundancy-analysis\n"
     "                            Disables redundant memory access analysis.\n"
+    "  bbentry mode options:\n"
+    "    --frequency-size=1|2|4  The size, in bytes, of the basic-block entry\n"
+    "                            counters. Narrower counters saturate and\n"
+    "                            spill their overflows to a side table in\n"
+    "                            the agent. Defaults to 4.\n"
     "  branch mode options:\n"
     "    --buffering             Enable per-thread buffering of events.\n"
     "    --fs-slot=<slot>        Specify which FS slot to use for thread\n"
     "                            local storage.\n"
+    "  coverage mode options:\n"
+    "    --edge-coverage         Record the edges between basic blocks in a\n"
+    "                            fixed-size hashed bitmap rather than the\n"
+    "                            basic blocks themselves. The agent maps the\n"
+    "                            bitmap from the shared memory named by the\n"
+    "                            SYZYGY_COVERAGE_EDGE_BITMAP environment\n"
+    "                            variable, if set.\n"
+    "    --page-coverage         Leave the basic blocks uninstrumented and\n"
+    "                            have the agent record the code pages that\n"
+    "                            execute, by guarding them when the module\n"
+    "                            loads. Exclusive with --edge-coverage.\n"
     "  calltrace mode options:\n"
     "    --instrument-imports    Also instrument calls to imports.\n"
     "    --module-entry-only     If specified then the per-function entry\n"
@@ -105,80 +205,434 @@ static const char kUsageFormatStr[] =
     "    --no-unsafe-refs        Perform no instrumentation of references\n"
     "                            between code blocks that contain anything\n"
     "                            but C/C++.\n"
+    "    --pack-thunks           Pack the entry thunks densely into tables\n"
+    "                            in function order, sharing their jumps to\n"
+    "                            the hooks.\n"
     "  profile mode options:\n"
+    "    --filter=<path>         Specifies a filter of the functions not to\n"
+    "                            instrument.\n"
+    "    --hot-filter=<path>     Specifies a filter of the hot functions.\n"
+    "                            Only these and their callers are\n"
+    "                            instrumented, along with the module's\n"
+    "                            entry points.\n"
+    "    --hot-heat-percent=<percent>\n"
+    "                            The percentage of the sampled heat the hot\n"
+    "                            functions account for. Defaults to 95.\n"
+    "    --hot-samples=<path>    Specifies a basic-block heat map output in\n"
+    "                            CSV format by the sample grinder, from which\n"
+    "                            the hot functions are derived. Exclusive\n"
+    "                            with --hot-filter.\n"
     "    --instrument-imports    Also instrument calls to imports.\n"
+    "    --min-leaf-instructions=<count>\n"
+    "                            Don't instrument the functions that make no\n"
+    "                            calls and have fewer instructions than this.\n"
+    "                            Defaults to 0.\n"
+    "    --shadow-stack          Call an exit hook before each return, and\n"
+    "                            have the profiler keep a shadow stack of\n"
+    "                            entries rather than redirect the return\n"
+    "                            addresses through thunks.\n"
     "\n";
 
+// Gets the optional path @p key of a manifest entry, resolving it relative
+// to @p base_dir.
+// @returns false if the value of @p key is not a string.
+bool GetManifestPath(const base::FilePath& base_dir,
+                     const DictionaryValue& dict,
+                     const char* key,
+                     base::FilePath* path) {
+  DCHECK(key != NULL);
+  DCHECK(path != NULL);
+
+  *path = base::FilePath();
+  if (!dict.HasKey(key))
+    return true;
+
+  std::string value;
+  if (!dict.GetString(key, &value) || value.empty()) {
+    LOG(ERROR) << "Invalid " << key << " in batch manifest.";
+    return false;
+  }
+  *path = base::FilePath(UTF8ToWide(value));
+  if (!path->IsAbsolute())
+    *path = base_dir.Append(*path);
+
+  return true;
+}
+
 }  // namespace
 
-void InstrumentApp::ParseDeprecatedMode(const CommandLine* cmd_line) {
+InstrumenterInterface* InstrumentApp::ParseDeprecatedMode(
+    const CommandLine* cmd_line) {
   DCHECK(cmd_line != NULL);
 
   std::string client = cmd_line->GetSwitchValueASCII("call-trace-client");
 
   if (client.empty()) {
     LOG(INFO) << "DEPRECATED: No mode specified, using --mode=calltrace.";
-    instrumenter_.reset(new instrumenters::EntryThunkInstrumenter(
-        instrumenters::EntryThunkInstrumenter::CALL_TRACE));
-    return;
+    return new instrumenters::EntryThunkInstrumenter(
+        instrumenters::EntryThunkInstrumenter::CALL_TRACE);
   }
 
   if (LowerCaseEqualsASCII(client, "profiler")) {
     LOG(INFO) << "DEPRECATED: Using --mode=profile.";
-    instrumenter_.reset(new instrumenters::EntryThunkInstrumenter(
-        instrumenters::EntryThunkInstrumenter::PROFILE));
+    return new instrumenters::EntryThunkInstrumenter(
+        instrumenters::EntryThunkInstrumenter::PROFILE);
   } else if (LowerCaseEqualsASCII(client, "rpc")) {
     LOG(INFO) << "DEPRECATED: Using --mode=calltrace.";
-    instrumenter_.reset(new instrumenters::EntryThunkInstrumenter(
-        instrumenters::EntryThunkInstrumenter::CALL_TRACE));
+    return new instrumenters::EntryThunkInstrumenter(
+        instrumenters::EntryThunkInstrumenter::CALL_TRACE);
   } else {
     LOG(INFO) << "DEPRECATED: Using --mode=calltrace --agent=" << client << ".";
-    instrumenter_.reset(new instrumenters::EntryThunkInstrumenter(
-        instrumenters::EntryThunkInstrumenter::CALL_TRACE));
+    return new instrumenters::EntryThunkInstrumenter(
+        instrumenters::EntryThunkInstrumenter::CALL_TRACE);
   }
 }
 
-bool InstrumentApp::ParseCommandLine(const CommandLine* cmd_line) {
+InstrumenterInterface* InstrumentApp::CreateInstrumenter(
+    const CommandLine* cmd_line, std::string* error) {
   DCHECK(cmd_line != NULL);
-
-  if (cmd_line->HasSwitch("help"))
-    return Usage(cmd_line, "");
+  DCHECK(error != NULL);
 
   // Get the mode and the default client DLL.
   if (!cmd_line->HasSwitch("mode")) {
     // TODO(chrisha): Remove this once build scripts and profiling tools have
     //     been updated.
-    ParseDeprecatedMode(cmd_line);
-  } else {
-    std::string mode = cmd_line->GetSwitchValueASCII("mode");
-    if (LowerCaseEqualsASCII(mode, "asan")) {
-      instrumenter_.reset(new instrumenters::AsanInstrumenter());
-    } else if (LowerCaseEqualsASCII(mode, "bbentry")) {
-      instrumenter_.reset(new instrumenters::BasicBlockEntryInstrumenter());
-    } else if (LowerCaseEqualsASCII(mode, "branch")) {
-      instrumenter_.reset(new instrumenters::BranchInstrumenter());
-    } else if (LowerCaseEqualsASCII(mode, "calltrace")) {
-      instrumenter_.reset(new instrumenters::EntryThunkInstrumenter(
-          instrumenters::EntryThunkInstrumenter::CALL_TRACE));
-    } else if (LowerCaseEqualsASCII(mode, "coverage")) {
-      instrumenter_.reset(new instrumenters::CoverageInstrumenter());
-    } else if (LowerCaseEqualsASCII(mode, "profile")) {
-      instrumenter_.reset(new instrumenters::EntryCallInstrumenter());
-    } else {
-      return Usage(cmd_line,
-                   base::StringPrintf("Unknown instrumentation mode: %s.",
-                                      mode.c_str()).c_str());
+    return ParseDeprecatedMode(cmd_line);
+  }
+
+  std::string mode = cmd_line->GetSwitchValueASCII("mode");
+  if (LowerCaseEqualsASCII(mode, "asan"))
+    return new instrumenters::AsanInstrumenter();
+  if (LowerCaseEqualsASCII(mode, "bbentry"))
+    return new instrumenters::BasicBlockEntryInstrumenter();
+  if (LowerCaseEqualsASCII(mode, "branch"))
+    return new instrumenters::BranchInstrumenter();
+  if (LowerCaseEqualsASCII(mode, "calltrace")) {
+    return new instrumenters::EntryThunkInstrumenter(
+        instrumenters::EntryThunkInstrumenter::CALL_TRACE);
+  }
+  if (LowerCaseEqualsASCII(mode, "coverage"))
+    return new instrumenters::CoverageInstrumenter();
+  if (LowerCaseEqualsASCII(mode, "profile"))
+    return new instrumenters::EntryCallInstrumenter();
+
+  *error = base::StringPrintf("Unknown instrumentation mode: %s.",
+                              mode.c_str());
+  return NULL;
+}
+
+bool InstrumentApp::ParseCommandLine(const CommandLine* cmd_line) {
+  DCHECK(cmd_line != NULL);
+
+  if (cmd_line->HasSwitch("help"))
+    return Usage(cmd_line, "");
+
+  std::string error;
+  instrumenter_.reset(CreateInstrumenter(cmd_line, &error));
+  if (instrumenter_.get() == NULL)
+    return Usage(cmd_line, error);
+
+  profile_output_path_ = AbsolutePath(
+      cmd_line->GetSwitchValuePath("profile-output"));
+
+  base::FilePath manifest_path = cmd_line->GetSwitchValuePath("manifest");
+  base::FilePath object_list_path =
+      cmd_line->GetSwitchValuePath("object-list");
+  if (manifest_path.empty() && object_list_path.empty())
+    return instrumenter_->ParseCommandLine(cmd_line);
+
+  // In batch mode each entry of the manifest, or each object file of the
+  // list, gets its own instrumenter.
+  instrumenter_.reset();
+
+  if (!manifest_path.empty() && !object_list_path.empty())
+    return Usage(cmd_line, "--manifest and --object-list are exclusive.");
+
+  if (cmd_line->HasSwitch("input-image") ||
+      cmd_line->HasSwitch("input-dll") ||
+      cmd_line->HasSwitch("output-image") ||
+      cmd_line->HasSwitch("output-dll")) {
+    return Usage(cmd_line,
+                 "The images to instrument are given by the manifest or the "
+                 "object list.");
+  }
+
+  if (cmd_line->HasSwitch("batch-threads")) {
+    std::string threads_str = cmd_line->GetSwitchValueASCII("batch-threads");
+    if (!base::StringToSizeT(threads_str, &batch_threads_) ||
+        batch_threads_ == 0) {
+      LOG(ERROR) << "Invalid batch-threads value: " << threads_str << ".";
+      return false;
+    }
+  }
+
+  if (!object_list_path.empty()) {
+    base::FilePath output_dir = cmd_line->GetSwitchValuePath("output-dir");
+    if (output_dir.empty())
+      return Usage(cmd_line, "--object-list requires --output-dir.");
+    if (!ParseObjectList(cmd_line, AbsolutePath(object_list_path),
+                         AbsolutePath(output_dir))) {
+      return false;
+    }
+    if (cmd_line->HasSwitch("batch-threads"))
+      coff_batch_relinker_->set_threads(batch_threads_);
+    coff_batch_relinker_->set_allow_overwrite(
+        cmd_line->HasSwitch("overwrite"));
+    return true;
+  }
+
+  return ParseManifest(cmd_line, AbsolutePath(manifest_path));
+}
+
+bool InstrumentApp::ParseManifest(const CommandLine* cmd_line,
+                                  const base::FilePath& manifest_path) {
+  DCHECK(cmd_line != NULL);
+
+  std::string file_string;
+  if (!file_util::ReadFileToString(manifest_path, &file_string)) {
+    LOG(ERROR) << "Unable to read batch manifest: " << manifest_path.value();
+    return false;
+  }
+
+  const ListValue* list = NULL;
+  scoped_ptr<Value> value(base::JSONReader::Read(file_string));
+  if (value.get() == NULL || !value->GetAsList(&list)) {
+    LOG(ERROR) << "Batch manifest does not contain a valid JSON list.";
+    return false;
+  }
+  if (list->GetSize() == 0) {
+    LOG(ERROR) << "Batch manifest contains no images.";
+    return false;
+  }
+
+  base::FilePath base_dir = manifest_path.DirName();
+  batch_instrumenters_.clear();
+  batch_output_paths_.clear();
+  for (size_t i = 0; i < list->GetSize(); ++i) {
+    const DictionaryValue* dict = NULL;
+    if (!list->GetDictionary(i, &dict)) {
+      LOG(ERROR) << "Item " << i << " of the batch manifest is not a "
+                 << "dictionary.";
+      return false;
+    }
+
+    base::FilePath input_image;
+    base::FilePath output_image;
+    base::FilePath input_pdb;
+    base::FilePath output_pdb;
+    base::FilePath filter;
+    if (!GetManifestPath(base_dir, *dict, kInputImageKey, &input_image) ||
+        !GetManifestPath(base_dir, *dict, kOutputImageKey, &output_image) ||
+        !GetManifestPath(base_dir, *dict, kInputPdbKey, &input_pdb) ||
+        !GetManifestPath(base_dir, *dict, kOutputPdbKey, &output_pdb) ||
+        !GetManifestPath(base_dir, *dict, kFilterKey, &filter)) {
+      return false;
     }
+    if (input_image.empty() || output_image.empty()) {
+      LOG(ERROR) << "Item " << i << " of the batch manifest is missing "
+                 << kInputImageKey << " or " << kOutputImageKey << ".";
+      return false;
+    }
+
+    // The paths of the entry replace those of the shared command-line.
+    CommandLine entry_cmd_line(*cmd_line);
+    entry_cmd_line.AppendSwitchPath("input-image", input_image);
+    entry_cmd_line.AppendSwitchPath("output-image", output_image);
+    if (!input_pdb.empty())
+      entry_cmd_line.AppendSwitchPath("input-pdb", input_pdb);
+    if (!output_pdb.empty())
+      entry_cmd_line.AppendSwitchPath("output-pdb", output_pdb);
+    if (!filter.empty())
+      entry_cmd_line.AppendSwitchPath("filter", filter);
+
+    std::string error;
+    scoped_ptr<InstrumenterInterface> instrumenter(
+        CreateInstrumenter(&entry_cmd_line, &error));
+    DCHECK(instrumenter.get() != NULL);
+    if (!instrumenter->ParseCommandLine(&entry_cmd_line)) {
+      LOG(ERROR) << "Invalid options for item " << i << " of the batch "
+                 << "manifest.";
+      return false;
+    }
+    batch_instrumenters_.push_back(instrumenter.release());
+    batch_output_paths_.push_back(output_image);
   }
-  DCHECK(instrumenter_.get() != NULL);
 
-  return instrumenter_->ParseCommandLine(cmd_line);
+  return true;
 }
 
 int InstrumentApp::Run() {
-  DCHECK(instrumenter_.get() != NULL);
+  if (coff_batch_relinker_.get() != NULL) {
+    if (RunObjectList() != 0)
+      return 1;
+  } else if (!batch_instrumenters_.empty()) {
+    if (RunBatch() != 0)
+      return 1;
+  } else {
+    DCHECK(instrumenter_.get() != NULL);
+    if (!instrumenter_->Instrument())
+      return 1;
+  }
+
+  if (!profile_output_path_.empty() &&
+      !common::StageProfiler::Instance()->SaveToFile(profile_output_path_)) {
+    return 1;
+  }
+
+  return 0;
+}
+
+int InstrumentApp::RunBatch() {
+  DCHECK(!batch_instrumenters_.empty());
+  DCHECK_LT(0u, batch_threads_);
+
+  size_t image_count = batch_instrumenters_.size();
+  base::subtle::Atomic32 failures = 0;
+  base::Time start_time = base::Time::Now();
+
+  {
+    ScopedVector<core::ClosureDelegate> delegates;
+    base::DelegateSimpleThreadPool pool(
+        "InstrumentBatch", std::min(batch_threads_, image_count));
+    pool.Start();
+    for (size_t i = 0; i < image_count; ++i) {
+      delegates.push_back(new core::ClosureDelegate(
+          base::Bind(&InstrumentApp::InstrumentBatchEntry,
+                     base::Unretained(this),
+                     i,
+                     &failures)));
+      pool.AddWork(delegates.back());
+    }
+    pool.JoinAll();
+  }
+
+  base::TimeDelta elapsed = base::Time::Now() - start_time;
+  size_t failure_count =
+      static_cast<size_t>(base::subtle::NoBarrier_Load(&failures));
+  LOG(INFO) << "Instrumented " << image_count - failure_count << " of "
+            << image_count << " images in " << elapsed.InSecondsF()
+            << " seconds on " << std::min(batch_threads_, image_count)
+            << " threads.";
+
+  return failure_count == 0 ? 0 : 1;
+}
+
+void InstrumentApp::InstrumentBatchEntry(size_t index,
+                                         base::subtle::Atomic32* failures) {
+  DCHECK_LT(index, batch_instrumenters_.size());
+  DCHECK(failures != NULL);
+
+  // The decomposer uses DIA, which needs COM on this thread.
+  base::win::ScopedCOMInitializer com_initializer;
+
+  // Take ownership of the instrumenter so that the image it holds is released
+  // as soon as it has been written.
+  scoped_ptr<InstrumenterInterface> instrumenter(batch_instrumenters_[index]);
+  batch_instrumenters_[index] = NULL;
+  DCHECK(instrumenter.get() != NULL);
+
+  const base::FilePath& output_path = batch_output_paths_[index];
+  base::Time start_time = base::Time::Now();
+  if (!instrumenter->Instrument()) {
+    LOG(ERROR) << "Failed to instrument " << output_path.value() << ".";
+    base::subtle::NoBarrier_AtomicIncrement(failures, 1);
+    return;
+  }
+
+  LOG(INFO) << "Wrote " << output_path.value() << " in "
+            << (base::Time::Now() - start_time).InSecondsF() << " seconds.";
+}
+
+bool InstrumentApp::ParseObjectList(const CommandLine* cmd_line,
+                                    const base::FilePath& object_list_path,
+                                    const base::FilePath& output_dir) {
+  DCHECK(cmd_line != NULL);
+
+  std::string file_string;
+  if (!file_util::ReadFileToString(object_list_path, &file_string)) {
+    LOG(ERROR) << "Unable to read object list: " << object_list_path.value();
+    return false;
+  }
+
+  std::vector<std::string> lines;
+  base::SplitString(file_string, '\n', &lines);
+
+  base::FilePath base_dir = object_list_path.DirName();
+  coff_batch_relinker_.reset(new pe::CoffBatchRelinker(&coff_policy_));
+  object_instrumenters_.clear();
+  object_indices_.clear();
+  for (size_t i = 0; i < lines.size(); ++i) {
+    std::string line;
+    TrimWhitespaceASCII(lines[i], TRIM_ALL, &line);
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    base::FilePath input_path(UTF8ToWide(line));
+    if (!input_path.IsAbsolute())
+      input_path = base_dir.Append(input_path);
+    base::FilePath output_path = output_dir.Append(input_path.BaseName());
+    if (object_indices_.count(output_path) != 0) {
+      LOG(ERROR) << "Line " << i + 1 << " of the object list has the same "
+                 << "name as a previous object file: " << line;
+      return false;
+    }
+
+    // The paths of the object file replace those of the shared command-line.
+    CommandLine object_cmd_line(*cmd_line);
+    object_cmd_line.AppendSwitchPath("input-image", input_path);
+    object_cmd_line.AppendSwitchPath("output-image", output_path);
+
+    // Every mode is implemented by an InstrumenterWithAgent.
+    std::string error;
+    scoped_ptr<instrumenters::InstrumenterWithAgent> instrumenter(
+        static_cast<instrumenters::InstrumenterWithAgent*>(
+            CreateInstrumenter(&object_cmd_line, &error)));
+    DCHECK(instrumenter.get() != NULL);
+    if (!instrumenter->ParseCommandLine(&object_cmd_line)) {
+      LOG(ERROR) << "Invalid options for line " << i + 1 << " of the object "
+                 << "list.";
+      return false;
+    }
+
+    object_indices_[output_path] = object_instrumenters_.size();
+    object_instrumenters_.push_back(instrumenter.release());
+    coff_batch_relinker_->AddObjectFile(input_path, output_path);
+  }
+
+  if (object_instrumenters_.empty()) {
+    LOG(ERROR) << "Object list contains no object files.";
+    return false;
+  }
+
+  return true;
+}
+
+int InstrumentApp::RunObjectList() {
+  DCHECK(coff_batch_relinker_.get() != NULL);
+
+  coff_batch_relinker_->set_configure_callback(
+      base::Bind(&InstrumentApp::ConfigureObjectFile, base::Unretained(this)));
+
+  base::Time start_time = base::Time::Now();
+  bool success = coff_batch_relinker_->RelinkAll();
+  LOG(INFO) << "Instrumented " << object_instrumenters_.size() << " object "
+            << "file(s) in " << (base::Time::Now() - start_time).InSecondsF()
+            << " seconds.";
+
+  return success ? 0 : 1;
+}
+
+bool InstrumentApp::ConfigureObjectFile(
+    pe::CoffRelinker* relinker,
+    pe::CoffBatchRelinker::RelinkerObjects* /* objects */) {
+  DCHECK(relinker != NULL);
+
+  std::map<base::FilePath, size_t>::const_iterator it =
+      object_indices_.find(relinker->output_path());
+  DCHECK(it != object_indices_.end());
+  DCHECK_LT(it->second, object_instrumenters_.size());
 
-  return instrumenter_->Instrument() ? 0 : 1;
+  return object_instrumenters_[it->second]->InstrumentCoffRelinker(relinker);
 }
 
 bool InstrumentApp::Usage(const CommandLine* cmd_line,
@@ -18,12 +18,19 @@
 #ifndef SYZYGY_INSTRUMENT_INSTRUMENT_APP_H_
 #define SYZYGY_INSTRUMENT_INSTRUMENT_APP_H_
 
+#include <map>
+#include <vector>
+
+#include "base/atomicops.h"
 #include "base/command_line.h"
 #include "base/string_piece.h"
 #include "base/time.h"
 #include "base/files/file_path.h"
+#include "base/memory/scoped_vector.h"
 #include "syzygy/common/application.h"
 #include "syzygy/instrument/instrumenter.h"
+#include "syzygy/instrument/instrumenters/instrumenter_with_agent.h"
+#include "syzygy/pe/coff_batch_relinker.h"
 
 namespace instrument {
 
@@ -34,7 +41,7 @@ namespace instrument {
 class InstrumentApp : public common::AppImplBase {
  public:
   InstrumentApp()
-      : common::AppImplBase("Instrumenter") {
+      : common::AppImplBase("Instrumenter"), batch_threads_(1) {
   }
 
   // @name Implementation of the AppImplBase interface.
@@ -53,10 +60,95 @@ class InstrumentApp : public common::AppImplBase {
   // Used to parse old-style deprecated command-lines.
   // TODO(chrisha): Remove this once build scripts and profiling tools have
   //     been updated.
-  void ParseDeprecatedMode(const CommandLine* command_line);
+  // @returns the instrumenter to use.
+  InstrumenterInterface* ParseDeprecatedMode(const CommandLine* command_line);
+
+  // Creates the instrumenter for the mode selected on the command-line.
+  // @param command_line the command-line to parse.
+  // @param error receives an error message on failure.
+  // @returns the instrumenter, or NULL if the mode is unknown.
+  InstrumenterInterface* CreateInstrumenter(const CommandLine* command_line,
+                                            std::string* error);
+
+  // @name Batch mode.
+  // @{
+  // Parses the manifest of a batch, creating an instrumenter for each of its
+  // entries. Each instrumenter is configured with @p command_line, with the
+  // paths of its entry replacing the image, PDB and filter paths.
+  // @param command_line the command-line shared by all entries.
+  // @param manifest_path the path of the manifest.
+  // @returns true on success, false otherwise.
+  bool ParseManifest(const CommandLine* command_line,
+                     const base::FilePath& manifest_path);
+
+  // Instruments all the entries of the batch on a pool of threads.
+  // @returns the exit code of the application.
+  int RunBatch();
+
+  // Runs and then releases the instrumenter of a batch entry. This is run on
+  // a worker thread.
+  // @param index the index of the entry.
+  // @param failures is incremented if the instrumentation fails.
+  void InstrumentBatchEntry(size_t index, base::subtle::Atomic32* failures);
+  // @}
+
+  // @name Object list mode.
+  // @{
+  // Parses a list of COFF object files, creating an instrumenter for each of
+  // them and adding them to a batch relinker. Each instrumenter is configured
+  // with @p command_line, with the paths of its object file replacing the
+  // image paths.
+  // @param command_line the command-line shared by all object files.
+  // @param object_list_path the path of the object list.
+  // @param output_dir the directory the object files are written to.
+  // @returns true on success, false otherwise.
+  bool ParseObjectList(const CommandLine* command_line,
+                       const base::FilePath& object_list_path,
+                       const base::FilePath& output_dir);
+
+  // Relinks and instruments all of the listed object files.
+  // @returns the exit code of the application.
+  int RunObjectList();
+
+  // Configures the relinker of a listed object file with its instrumenter.
+  // This is run concurrently on the worker threads of the batch relinker.
+  // @param relinker the relinker of the object file.
+  // @param objects unused, the transforms are owned by the instrumenter.
+  // @returns true on success, false otherwise.
+  bool ConfigureObjectFile(pe::CoffRelinker* relinker,
+                           pe::CoffBatchRelinker::RelinkerObjects* objects);
+  // @}
+
+  // The path of the stage profile to write, if any.
+  base::FilePath profile_output_path_;
 
   // The instrumenter we delegate to.
   scoped_ptr<InstrumenterInterface> instrumenter_;
+
+  // @name Batch mode state.
+  // @{
+  // The number of images instrumented concurrently.
+  size_t batch_threads_;
+  // The instrumenters of the batch entries. An entry is set to NULL once it
+  // has been run, so that its memory is released as soon as possible.
+  ScopedVector<InstrumenterInterface> batch_instrumenters_;
+  // The output images of the batch entries, for reporting.
+  std::vector<base::FilePath> batch_output_paths_;
+  // @}
+
+  // @name Object list mode state.
+  // @{
+  // The policy shared by the relinkers of the object files.
+  pe::CoffTransformPolicy coff_policy_;
+  // Relinks the listed object files. This is NULL unless an object list was
+  // given.
+  scoped_ptr<pe::CoffBatchRelinker> coff_batch_relinker_;
+  // The instrumenters of the object files, in the order they were listed.
+  ScopedVector<instrumenters::InstrumenterWithAgent> object_instrumenters_;
+  // Maps the output path of each object file to the index of its
+  // instrumenter. This is only read once the batch is running.
+  std::map<base::FilePath, size_t> object_indices_;
+  // @}
 };
 
 }  // namespace instrument
@@ -15,7 +15,11 @@
 #include "syzygy/instrument/instrument_app.h"
 
 #include "base/environment.h"
+#include "base/file_util.h"
 #include "base/stringprintf.h"
+#include "base/utf_string_conversions.h"
+#include "base/values.h"
+#include "base/json/json_writer.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/block_graph/unittest_util.h"
@@ -33,7 +37,11 @@ namespace {
 
 class TestInstrumentApp : public InstrumentApp {
  public:
+  using InstrumentApp::batch_instrumenters_;
+  using InstrumentApp::batch_threads_;
   using InstrumentApp::instrumenter_;
+  using InstrumentApp::object_instrumenters_;
+  using InstrumentApp::profile_output_path_;
 };
 
 typedef common::Application<TestInstrumentApp> TestApp;
@@ -111,6 +119,35 @@ class InstrumentAppTest : public testing::PELibUnitTest {
   // @}
 };
 
+// Writes a batch manifest instrumenting @p input_image to each of
+// @p output_names, which are relative to the manifest.
+void WriteManifest(const base::FilePath& path,
+                   const base::FilePath& input_image,
+                   const char* const* output_names,
+                   size_t output_count) {
+  base::ListValue list;
+  for (size_t i = 0; i < output_count; ++i) {
+    base::DictionaryValue* dict = new base::DictionaryValue();
+    dict->SetString("input_image", WideToUTF8(input_image.value()));
+    dict->SetString("output_image", output_names[i]);
+    list.Append(dict);
+  }
+  std::string json;
+  base::JSONWriter::Write(&list, &json);
+  ASSERT_EQ(static_cast<int>(json.size()),
+            file_util::WriteFile(path, json.data(), json.size()));
+}
+
+// Writes an object list naming @p object_paths, one per line.
+void WriteObjectList(const base::FilePath& path,
+                     const std::vector<base::FilePath>& object_paths) {
+  std::string contents = "# Object files to instrument.\n";
+  for (size_t i = 0; i < object_paths.size(); ++i)
+    contents += WideToUTF8(object_paths[i].value()) + "\n";
+  ASSERT_EQ(static_cast<int>(contents.size()),
+            file_util::WriteFile(path, contents.data(), contents.size()));
+}
+
 }  // namespace
 
 TEST_F(InstrumentAppTest, GetHelp) {
@@ -185,4 +222,108 @@ TEST_F(InstrumentAppTest, Run) {
   ASSERT_EQ(0, test_impl_.Run());
 }
 
+TEST_F(InstrumentAppTest, RunWithProfileOutput) {
+  base::FilePath profile_output_path = temp_dir_.Append(L"profile.json");
+  cmd_line_.AppendSwitchPath("input-image", input_dll_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_dll_path_);
+  cmd_line_.AppendSwitchASCII("mode", "calltrace");
+  cmd_line_.AppendSwitchPath("profile-output", profile_output_path);
+
+  EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(profile_output_path, test_impl_.profile_output_path_);
+  ASSERT_EQ(0, test_impl_.Run());
+  EXPECT_TRUE(file_util::PathExists(profile_output_path));
+}
+
+TEST_F(InstrumentAppTest, ParseManifestWithOutputImageFails) {
+  base::FilePath manifest_path = temp_dir_.Append(L"manifest.json");
+  const char* kOutputNames[] = { "batch.dll" };
+  ASSERT_NO_FATAL_FAILURE(WriteManifest(manifest_path, input_dll_path_,
+                                        kOutputNames,
+                                        arraysize(kOutputNames)));
+  cmd_line_.AppendSwitchASCII("mode", "calltrace");
+  cmd_line_.AppendSwitchPath("manifest", manifest_path);
+  cmd_line_.AppendSwitchPath("output-image", output_dll_path_);
+
+  EXPECT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(InstrumentAppTest, ParseInvalidManifestFails) {
+  base::FilePath manifest_path = temp_dir_.Append(L"manifest.json");
+  const char kManifest[] = "[ { \"output_image\": \"batch.dll\" } ]";
+  ASSERT_EQ(static_cast<int>(sizeof(kManifest) - 1),
+            file_util::WriteFile(manifest_path, kManifest,
+                                 sizeof(kManifest) - 1));
+  cmd_line_.AppendSwitchASCII("mode", "calltrace");
+  cmd_line_.AppendSwitchPath("manifest", manifest_path);
+
+  EXPECT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(InstrumentAppTest, RunBatch) {
+  base::FilePath manifest_path = temp_dir_.Append(L"manifest.json");
+  const char* kOutputNames[] = { "batch1.dll", "batch2.dll", "batch3.dll" };
+  ASSERT_NO_FATAL_FAILURE(WriteManifest(manifest_path, input_dll_path_,
+                                        kOutputNames,
+                                        arraysize(kOutputNames)));
+  cmd_line_.AppendSwitchASCII("mode", "calltrace");
+  cmd_line_.AppendSwitchPath("manifest", manifest_path);
+  cmd_line_.AppendSwitchASCII("batch-threads", "2");
+
+  EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(2u, test_impl_.batch_threads_);
+  EXPECT_EQ(arraysize(kOutputNames), test_impl_.batch_instrumenters_.size());
+  ASSERT_EQ(0, test_impl_.Run());
+
+  // Each of the outputs has been written, relative to the manifest.
+  for (size_t i = 0; i < arraysize(kOutputNames); ++i) {
+    EXPECT_TRUE(file_util::PathExists(temp_dir_.AppendASCII(kOutputNames[i])));
+  }
+}
+
+TEST_F(InstrumentAppTest, ParseObjectListWithoutOutputDirFails) {
+  base::FilePath object_list_path = temp_dir_.Append(L"objects.txt");
+  std::vector<base::FilePath> object_paths(1,
+      testing::GetExeTestDataRelativePath(testing::kTestDllCoffObjName));
+  ASSERT_NO_FATAL_FAILURE(WriteObjectList(object_list_path, object_paths));
+  cmd_line_.AppendSwitchASCII("mode", "asan");
+  cmd_line_.AppendSwitchPath("object-list", object_list_path);
+
+  EXPECT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(InstrumentAppTest, ParseObjectListWithDuplicateNamesFails) {
+  base::FilePath object_list_path = temp_dir_.Append(L"objects.txt");
+  std::vector<base::FilePath> object_paths(2,
+      testing::GetExeTestDataRelativePath(testing::kTestDllCoffObjName));
+  ASSERT_NO_FATAL_FAILURE(WriteObjectList(object_list_path, object_paths));
+  cmd_line_.AppendSwitchASCII("mode", "asan");
+  cmd_line_.AppendSwitchPath("object-list", object_list_path);
+  cmd_line_.AppendSwitchPath("output-dir", temp_dir_);
+
+  EXPECT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(InstrumentAppTest, RunObjectList) {
+  base::FilePath input_obj_path =
+      testing::GetExeTestDataRelativePath(testing::kTestDllCoffObjName);
+  base::FilePath output_dir = temp_dir_.Append(L"objects");
+  ASSERT_TRUE(file_util::CreateDirectory(output_dir));
+
+  base::FilePath object_list_path = temp_dir_.Append(L"objects.txt");
+  std::vector<base::FilePath> object_paths(1, input_obj_path);
+  ASSERT_NO_FATAL_FAILURE(WriteObjectList(object_list_path, object_paths));
+  cmd_line_.AppendSwitchASCII("mode", "asan");
+  cmd_line_.AppendSwitchPath("object-list", object_list_path);
+  cmd_line_.AppendSwitchPath("output-dir", output_dir);
+  cmd_line_.AppendSwitchASCII("batch-threads", "2");
+
+  EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(1u, test_impl_.object_instrumenters_.size());
+  ASSERT_EQ(0, test_impl_.Run());
+
+  EXPECT_TRUE(file_util::PathExists(
+      output_dir.Append(input_obj_path.BaseName())));
+}
+
 }  // namespace instrument
@@ -14,17 +14,142 @@
 
 #include "syzygy/instrument/instrumenters/asan_instrumenter.h"
 
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
 #include "base/file_util.h"
 #include "base/logging.h"
+#include "base/string_number_conversions.h"
 #include "syzygy/common/application.h"
+#include "syzygy/common/indexed_frequency_data.h"
+#include "syzygy/grinder/basic_block_util.h"
+#include "syzygy/grinder/indexed_frequency_data_serializer.h"
 
 namespace instrument {
 namespace instrumenters {
 
+namespace {
+
+using grinder::basic_block_util::EntryCountType;
+using grinder::basic_block_util::IndexedFrequencyInformation;
+using grinder::basic_block_util::IndexedFrequencyMap;
+using grinder::basic_block_util::ModuleIndexedFrequencyMap;
+
+// Loads the image filter stored at @p filter_path, and ensures that it's for
+// the module at @p image_path.
+// @param filter_path The path of the filter.
+// @param image_path The path of the module the filter must be for.
+// @param filter Will receive the image filter.
+// @returns true on success, false otherwise.
+bool LoadImageFilter(const base::FilePath& filter_path,
+                     const base::FilePath& image_path,
+                     scoped_ptr<pe::ImageFilter>* filter) {
+  DCHECK(filter != NULL);
+
+  filter->reset(new pe::ImageFilter());
+  if (!(*filter)->LoadFromJSON(filter_path)) {
+    LOG(ERROR) << "Failed to parse filter file: " << filter_path.value();
+    return false;
+  }
+
+  // Ensure it is for the input module.
+  if (!(*filter)->IsForModule(image_path)) {
+    LOG(ERROR) << "Filter does not match the input module.";
+    return false;
+  }
+
+  return true;
+}
+
+// Builds an image filter marking the hottest basic blocks of the module at
+// @p image_path, as per the basic-block entry counts stored at
+// @p entry_counts_path.
+// @param entry_counts_path The path of the basic-block entry counts.
+// @param image_path The path of the module the entry counts must be for.
+// @param hot_block_percent The percentage of the basic blocks that were
+//     entered to mark, starting with the most frequently entered one.
+// @param hot_filter Will receive the image filter.
+// @returns true on success, false otherwise.
+bool LoadHotBlocks(const base::FilePath& entry_counts_path,
+                   const base::FilePath& image_path,
+                   double hot_block_percent,
+                   scoped_ptr<pe::ImageFilter>* hot_filter) {
+  DCHECK_LT(0.0, hot_block_percent);
+  DCHECK_GE(100.0, hot_block_percent);
+  DCHECK(hot_filter != NULL);
+
+  hot_filter->reset(new pe::ImageFilter());
+  if (!(*hot_filter)->Init(image_path)) {
+    LOG(ERROR) << "Failed to read module: " << image_path.value();
+    return false;
+  }
+
+  ModuleIndexedFrequencyMap module_entry_count_map;
+  grinder::IndexedFrequencyDataSerializer serializer;
+  if (!serializer.Load(entry_counts_path, &module_entry_count_map)) {
+    LOG(ERROR) << "Failed to load basic-block entry counts: "
+               << entry_counts_path.value();
+    return false;
+  }
+
+  const IndexedFrequencyInformation* entry_counts = NULL;
+  if (!grinder::basic_block_util::FindIndexedFrequencyInfo(
+          (*hot_filter)->signature, module_entry_count_map, &entry_counts)) {
+    LOG(ERROR) << "Failed to find the basic-block entry counts for the input "
+               << "module.";
+    return false;
+  }
+
+  if (entry_counts->data_type !=
+          ::common::IndexedFrequencyData::BASIC_BLOCK_ENTRY &&
+      entry_counts->data_type != ::common::IndexedFrequencyData::BRANCH) {
+    LOG(ERROR) << "Invalid frequency data type.";
+    return false;
+  }
+
+  // Sort the basic blocks that were entered by decreasing entry count. The
+  // first column holds the entry counts for both data types.
+  typedef std::pair<EntryCountType, core::RelativeAddress> CountForBasicBlock;
+  std::vector<CountForBasicBlock> basic_blocks;
+  IndexedFrequencyMap::const_iterator it = entry_counts->frequency_map.begin();
+  for (; it != entry_counts->frequency_map.end(); ++it) {
+    if (it->first.second == 0 && it->second > 0)
+      basic_blocks.push_back(std::make_pair(it->second, it->first.first));
+  }
+  std::sort(basic_blocks.begin(), basic_blocks.end(),
+            std::greater<CountForBasicBlock>());
+
+  // Mark the first byte of the hottest basic blocks. This is enough for the
+  // basic blocks to be filtered.
+  size_t num_hot_blocks = static_cast<size_t>(
+      basic_blocks.size() * hot_block_percent / 100.0 + 0.5);
+  for (size_t i = 0; i < num_hot_blocks; ++i) {
+    (*hot_filter)->filter.Mark(
+        pe::ImageFilter::Range(basic_blocks[i].second, 1));
+  }
+
+  LOG(INFO) << "Marked " << num_hot_blocks << " of " << basic_blocks.size()
+            << " entered basic blocks as hot.";
+
+  return true;
+}
+
+}  // namespace
+
 const char AsanInstrumenter::kAgentDllAsan[] = "syzyasan_rtl.dll";
+const double AsanInstrumenter::kDefaultHotBlockPercent = 10.0;
 
 AsanInstrumenter::AsanInstrumenter()
-    : intercept_crt_functions_(true),
+    : count_checks_(false),
+      decomposition_threads_(1),
+      hoist_invariant_checks_(false),
+      hot_block_percent_(kDefaultHotBlockPercent),
+      inline_fast_path_(false),
+      instrumentation_rate_(1.0),
+      instrumentation_seed_(0),
+      intercept_crt_functions_(true),
       remove_redundant_checks_(true),
       use_liveness_analysis_(true) {
   agent_dll_ = kAgentDllAsan;
@@ -40,18 +165,25 @@ bool AsanInstrumenter::ImageFormatIsSupported(
 bool AsanInstrumenter::InstrumentImpl() {
   // Parse the filter if one was provided.
   scoped_ptr<pe::ImageFilter> filter;
-  if (!filter_path_.empty()) {
-    filter.reset(new pe::ImageFilter());
-    if (!filter->LoadFromJSON(filter_path_)) {
-      LOG(ERROR) << "Failed to parse filter file: " << filter_path_.value();
-      return false;
-    }
+  if (!filter_path_.empty() &&
+      !LoadImageFilter(filter_path_, input_image_path_, &filter)) {
+    return false;
+  }
 
-    // Ensure it is for the input module.
-    if (!filter->IsForModule(input_image_path_)) {
-      LOG(ERROR) << "Filter does not match the input module.";
-      return false;
-    }
+  // Likewise for the filter restricting where the fast path is inlined.
+  scoped_ptr<pe::ImageFilter> inline_filter;
+  if (!inline_filter_path_.empty() &&
+      !LoadImageFilter(inline_filter_path_, input_image_path_,
+                       &inline_filter)) {
+    return false;
+  }
+
+  // And for the hottest basic blocks, which get the cheapest checks.
+  scoped_ptr<pe::ImageFilter> hot_filter;
+  if (!hot_block_entry_counts_path_.empty() &&
+      !LoadHotBlocks(hot_block_entry_counts_path_, input_image_path_,
+                     hot_block_percent_, &hot_filter)) {
+    return false;
   }
 
   asan_transform_.reset(new instrument::transforms::AsanTransform());
@@ -59,12 +191,26 @@ bool AsanInstrumenter::InstrumentImpl() {
   asan_transform_->set_intercept_crt_functions(intercept_crt_functions_);
   asan_transform_->set_use_liveness_analysis(use_liveness_analysis_);
   asan_transform_->set_remove_redundant_checks(remove_redundant_checks_);
+  asan_transform_->set_hoist_invariant_checks(hoist_invariant_checks_);
+  asan_transform_->set_inline_fast_path(inline_fast_path_);
+  asan_transform_->set_instrumentation_rate(instrumentation_rate_);
+  asan_transform_->set_instrumentation_seed(instrumentation_seed_);
+  asan_transform_->set_decomposition_threads(decomposition_threads_);
+  asan_transform_->set_count_checks(count_checks_);
 
   // Set up the filter if one was provided.
   if (filter.get()) {
     filter_.reset(filter.release());
     asan_transform_->set_filter(&filter_->filter);
   }
+  if (inline_filter.get()) {
+    inline_filter_.reset(inline_filter.release());
+    asan_transform_->set_inline_filter(&inline_filter_->filter);
+  }
+  if (hot_filter.get()) {
+    hot_filter_.reset(hot_filter.release());
+    asan_transform_->set_hot_filter(&hot_filter_->filter);
+  }
 
   // Set overwrite source range flag in the ASAN transform. The ASAN
   // transformation will overwrite the source range of created instructions to
@@ -74,6 +220,17 @@ bool AsanInstrumenter::InstrumentImpl() {
   if (!relinker_->AppendTransform(asan_transform_.get()))
     return false;
 
+  // The checked instructions are recorded in place of the basic-block ranges,
+  // so that grinder processes the check counts like basic-block entry counts.
+  if (count_checks_) {
+    add_check_sites_stream_mutator_.reset(
+        new instrument::mutators::AddIndexedDataRangesStreamPdbMutator(
+            asan_transform_->check_sites(),
+            ::common::kBasicBlockRangesStreamName));
+    if (!relinker_->AppendPdbMutator(add_check_sites_stream_mutator_.get()))
+      return false;
+  }
+
   return true;
 }
 
@@ -84,6 +241,57 @@ bool AsanInstrumenter::ParseAdditionalCommandLineArguments(
   use_liveness_analysis_ = !command_line->HasSwitch("no-liveness-analysis");
   remove_redundant_checks_ = !command_line->HasSwitch("no-redundancy-analysis");
   intercept_crt_functions_ = !command_line->HasSwitch("no-crt-interceptors");
+  hoist_invariant_checks_ = command_line->HasSwitch("hoist-invariant-checks");
+  count_checks_ = command_line->HasSwitch("count-checks");
+  inline_filter_path_ = command_line->GetSwitchValuePath("inline-filter");
+  hot_block_entry_counts_path_ =
+      command_line->GetSwitchValuePath("hot-block-entry-counts");
+
+  // An inline filter is only meaningful when inlining the fast path.
+  inline_fast_path_ = command_line->HasSwitch("inline-fast-path") ||
+      !inline_filter_path_.empty();
+
+  if (command_line->HasSwitch("decomposition-threads")) {
+    std::string threads_str =
+        command_line->GetSwitchValueASCII("decomposition-threads");
+    if (!base::StringToSizeT(threads_str, &decomposition_threads_) ||
+        decomposition_threads_ == 0) {
+      LOG(ERROR) << "Invalid decomposition-threads value: " << threads_str
+                 << ".";
+      return false;
+    }
+  }
+
+  if (command_line->HasSwitch("instrumentation-rate")) {
+    std::string rate_str =
+        command_line->GetSwitchValueASCII("instrumentation-rate");
+    if (!base::StringToDouble(rate_str, &instrumentation_rate_) ||
+        instrumentation_rate_ < 0.0 || instrumentation_rate_ > 1.0) {
+      LOG(ERROR) << "Invalid instrumentation-rate value: " << rate_str << ".";
+      return false;
+    }
+  }
+
+  if (command_line->HasSwitch("instrumentation-seed")) {
+    std::string seed_str =
+        command_line->GetSwitchValueASCII("instrumentation-seed");
+    size_t seed = 0;
+    if (!base::StringToSizeT(seed_str, &seed)) {
+      LOG(ERROR) << "Invalid instrumentation-seed value: " << seed_str << ".";
+      return false;
+    }
+    instrumentation_seed_ = static_cast<uint32>(seed);
+  }
+
+  if (command_line->HasSwitch("hot-block-percent")) {
+    std::string percent_str =
+        command_line->GetSwitchValueASCII("hot-block-percent");
+    if (!base::StringToDouble(percent_str, &hot_block_percent_) ||
+        hot_block_percent_ <= 0.0 || hot_block_percent_ > 100.0) {
+      LOG(ERROR) << "Invalid hot-block-percent value: " << percent_str << ".";
+      return false;
+    }
+  }
 
   return true;
 }
@@ -20,6 +20,7 @@
 
 #include "base/command_line.h"
 #include "syzygy/instrument/instrumenters/instrumenter_with_agent.h"
+#include "syzygy/instrument/mutators/add_indexed_data_ranges_stream.h"
 #include "syzygy/instrument/transforms/asan_transform.h"
 #include "syzygy/pe/image_filter.h"
 #include "syzygy/pe/pe_relinker.h"
@@ -37,6 +38,9 @@ class AsanInstrumenter : public InstrumenterWithAgent {
   // The name of the agent for this mode of instrumentation.
   static const char kAgentDllAsan[];
 
+  // The default percentage of the basic blocks that are considered hot.
+  static const double kDefaultHotBlockPercent;
+
   // @name InstrumenterWithAgent overrides.
   // @{
   virtual bool ImageFormatIsSupported(pe::ImageFormat image_format) OVERRIDE;
@@ -49,6 +53,15 @@ class AsanInstrumenter : public InstrumenterWithAgent {
   // @name Command-line parameters.
   // @{
   base::FilePath filter_path_;
+  base::FilePath inline_filter_path_;
+  base::FilePath hot_block_entry_counts_path_;
+  bool count_checks_;
+  size_t decomposition_threads_;
+  bool hoist_invariant_checks_;
+  double hot_block_percent_;
+  bool inline_fast_path_;
+  double instrumentation_rate_;
+  uint32 instrumentation_seed_;
   bool intercept_crt_functions_;
   bool remove_redundant_checks_;
   bool use_liveness_analysis_;
@@ -59,6 +72,18 @@ class AsanInstrumenter : public InstrumenterWithAgent {
 
   // The image filter (optional).
   scoped_ptr<pe::ImageFilter> filter_;
+
+  // The image filter marking the code the fast path is inlined into
+  // (optional).
+  scoped_ptr<pe::ImageFilter> inline_filter_;
+
+  // The image filter marking the hottest basic blocks (optional).
+  scoped_ptr<pe::ImageFilter> hot_filter_;
+
+  // The PDB mutator recording the checked instructions, when the checks are
+  // counted.
+  scoped_ptr<instrument::mutators::AddIndexedDataRangesStreamPdbMutator>
+      add_check_sites_stream_mutator_;
 };
 
 }  // namespace instrumenters
@@ -39,10 +39,21 @@ class TestAsanInstrumenter : public AsanInstrumenter {
   using AsanInstrumenter::no_parse_debug_info_;
   using AsanInstrumenter::no_strip_strings_;
   using AsanInstrumenter::filter_path_;
+  using AsanInstrumenter::count_checks_;
+  using AsanInstrumenter::decomposition_threads_;
+  using AsanInstrumenter::hoist_invariant_checks_;
+  using AsanInstrumenter::hot_block_entry_counts_path_;
+  using AsanInstrumenter::hot_block_percent_;
+  using AsanInstrumenter::hot_filter_;
+  using AsanInstrumenter::inline_fast_path_;
+  using AsanInstrumenter::inline_filter_path_;
+  using AsanInstrumenter::instrumentation_rate_;
+  using AsanInstrumenter::instrumentation_seed_;
   using AsanInstrumenter::debug_friendly_;
   using AsanInstrumenter::use_liveness_analysis_;
   using AsanInstrumenter::remove_redundant_checks_;
   using AsanInstrumenter::kAgentDllAsan;
+  using AsanInstrumenter::kDefaultHotBlockPercent;
   using AsanInstrumenter::InstrumentImpl;
   using InstrumenterWithAgent::CreateRelinker;
 
@@ -83,6 +94,8 @@ class AsanInstrumenterTest : public testing::PELibUnitTest {
     output_pdb_path_ = temp_dir_.Append(input_pdb_path_.BaseName());
     test_dll_filter_path_ = temp_dir_.Append(L"test_dll_filter.json");
     dummy_filter_path_ = temp_dir_.Append(L"dummy_filter.json");
+    entry_counts_path_ = testing::GetExeTestDataRelativePath(
+        L"basic_block_entry_traces\\entry_counts.json");
   }
 
   void SetUpValidCommandLine() {
@@ -123,6 +136,7 @@ class AsanInstrumenterTest : public testing::PELibUnitTest {
   base::FilePath output_pdb_path_;
   base::FilePath test_dll_filter_path_;
   base::FilePath dummy_filter_path_;
+  base::FilePath entry_counts_path_;
   // @}
 
   // @name Expected final values of input parameters.
@@ -152,6 +166,16 @@ TEST_F(AsanInstrumenterTest, ParseMinimalAsan) {
   EXPECT_FALSE(instrumenter_.no_parse_debug_info_);
   EXPECT_FALSE(instrumenter_.no_strip_strings_);
   EXPECT_FALSE(instrumenter_.debug_friendly_);
+  EXPECT_FALSE(instrumenter_.count_checks_);
+  EXPECT_EQ(1u, instrumenter_.decomposition_threads_);
+  EXPECT_FALSE(instrumenter_.hoist_invariant_checks_);
+  EXPECT_TRUE(instrumenter_.hot_block_entry_counts_path_.empty());
+  EXPECT_EQ(TestAsanInstrumenter::kDefaultHotBlockPercent,
+            instrumenter_.hot_block_percent_);
+  EXPECT_FALSE(instrumenter_.inline_fast_path_);
+  EXPECT_TRUE(instrumenter_.inline_filter_path_.empty());
+  EXPECT_EQ(1.0, instrumenter_.instrumentation_rate_);
+  EXPECT_EQ(0u, instrumenter_.instrumentation_seed_);
   EXPECT_TRUE(instrumenter_.intercept_crt_functions_);
   EXPECT_TRUE(instrumenter_.use_liveness_analysis_);
   EXPECT_TRUE(instrumenter_.remove_redundant_checks_);
@@ -161,8 +185,17 @@ TEST_F(AsanInstrumenterTest, ParseFullAsan) {
   SetUpValidCommandLine();
   cmd_line_.AppendSwitchPath("filter", test_dll_filter_path_);
   cmd_line_.AppendSwitchASCII("agent", "foo.dll");
+  cmd_line_.AppendSwitch("count-checks");
   cmd_line_.AppendSwitch("debug-friendly");
+  cmd_line_.AppendSwitchASCII("decomposition-threads", "4");
+  cmd_line_.AppendSwitch("hoist-invariant-checks");
+  cmd_line_.AppendSwitchPath("hot-block-entry-counts", entry_counts_path_);
+  cmd_line_.AppendSwitchASCII("hot-block-percent", "25");
+  cmd_line_.AppendSwitch("inline-fast-path");
+  cmd_line_.AppendSwitchPath("inline-filter", test_dll_filter_path_);
   cmd_line_.AppendSwitchPath("input-pdb", input_pdb_path_);
+  cmd_line_.AppendSwitchASCII("instrumentation-rate", "0.5");
+  cmd_line_.AppendSwitchASCII("instrumentation-seed", "42");
   cmd_line_.AppendSwitch("new-decomposer");
   cmd_line_.AppendSwitch("no-augment-pdb");
   cmd_line_.AppendSwitch("no-crt-interceptors");
@@ -187,11 +220,34 @@ TEST_F(AsanInstrumenterTest, ParseFullAsan) {
   EXPECT_TRUE(instrumenter_.no_parse_debug_info_);
   EXPECT_TRUE(instrumenter_.no_strip_strings_);
   EXPECT_TRUE(instrumenter_.debug_friendly_);
+  EXPECT_TRUE(instrumenter_.count_checks_);
+  EXPECT_EQ(4u, instrumenter_.decomposition_threads_);
+  EXPECT_TRUE(instrumenter_.hoist_invariant_checks_);
+  EXPECT_EQ(entry_counts_path_, instrumenter_.hot_block_entry_counts_path_);
+  EXPECT_EQ(25.0, instrumenter_.hot_block_percent_);
+  EXPECT_TRUE(instrumenter_.inline_fast_path_);
+  EXPECT_EQ(test_dll_filter_path_, instrumenter_.inline_filter_path_);
+  EXPECT_EQ(0.5, instrumenter_.instrumentation_rate_);
+  EXPECT_EQ(42u, instrumenter_.instrumentation_seed_);
   EXPECT_FALSE(instrumenter_.intercept_crt_functions_);
   EXPECT_FALSE(instrumenter_.use_liveness_analysis_);
   EXPECT_FALSE(instrumenter_.remove_redundant_checks_);
 }
 
+TEST_F(AsanInstrumenterTest, ParseInvalidInstrumentationRate) {
+  SetUpValidCommandLine();
+  cmd_line_.AppendSwitchASCII("instrumentation-rate", "1.5");
+
+  EXPECT_FALSE(instrumenter_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(AsanInstrumenterTest, ParseInvalidHotBlockPercent) {
+  SetUpValidCommandLine();
+  cmd_line_.AppendSwitchASCII("hot-block-percent", "0");
+
+  EXPECT_FALSE(instrumenter_.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(AsanInstrumenterTest, InstrumentImpl) {
   SetUpValidCommandLine();
 
@@ -200,6 +256,15 @@ TEST_F(AsanInstrumenterTest, InstrumentImpl) {
   EXPECT_TRUE(instrumenter_.InstrumentImpl());
 }
 
+TEST_F(AsanInstrumenterTest, InstrumentImplCountingChecks) {
+  SetUpValidCommandLine();
+  cmd_line_.AppendSwitch("count-checks");
+
+  EXPECT_TRUE(instrumenter_.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(instrumenter_.CreateRelinker());
+  EXPECT_TRUE(instrumenter_.InstrumentImpl());
+}
+
 TEST_F(AsanInstrumenterTest, FailsWithInvalidFilter) {
   cmd_line_.AppendSwitchPath("input-image", input_image_path_);
   cmd_line_.AppendSwitchPath("output-image", output_image_path_);
@@ -214,6 +279,18 @@ TEST_F(AsanInstrumenterTest, FailsWithInvalidFilter) {
   EXPECT_FALSE(instrumenter_.InstrumentImpl());
 }
 
+TEST_F(AsanInstrumenterTest, FailsWithInvalidInlineFilter) {
+  cmd_line_.AppendSwitchPath("input-image", input_image_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_image_path_);
+  cmd_line_.AppendSwitchPath("inline-filter", dummy_filter_path_);
+
+  MakeFilters();
+  EXPECT_TRUE(instrumenter_.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(instrumenter_.inline_fast_path_);
+  EXPECT_TRUE(instrumenter_.CreateRelinker());
+  EXPECT_FALSE(instrumenter_.InstrumentImpl());
+}
+
 TEST_F(AsanInstrumenterTest, SucceedsWithValidFilter) {
   cmd_line_.AppendSwitchPath("input-image", input_image_path_);
   cmd_line_.AppendSwitchPath("output-image", output_image_path_);
@@ -225,5 +302,27 @@ TEST_F(AsanInstrumenterTest, SucceedsWithValidFilter) {
   EXPECT_TRUE(instrumenter_.InstrumentImpl());
 }
 
+TEST_F(AsanInstrumenterTest, SucceedsWithHotBlocks) {
+  SetUpValidCommandLine();
+  cmd_line_.AppendSwitchPath("hot-block-entry-counts", entry_counts_path_);
+
+  EXPECT_TRUE(instrumenter_.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(instrumenter_.CreateRelinker());
+  EXPECT_TRUE(instrumenter_.InstrumentImpl());
+  ASSERT_TRUE(instrumenter_.hot_filter_.get() != NULL);
+  EXPECT_FALSE(instrumenter_.hot_filter_->filter.empty());
+  EXPECT_TRUE(instrumenter_.hot_filter_->IsForModule(abs_input_image_path_));
+}
+
+TEST_F(AsanInstrumenterTest, FailsWithMissingHotBlockEntryCounts) {
+  SetUpValidCommandLine();
+  cmd_line_.AppendSwitchPath("hot-block-entry-counts",
+                             temp_dir_.Append(L"nonexistent.json"));
+
+  EXPECT_TRUE(instrumenter_.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(instrumenter_.CreateRelinker());
+  EXPECT_FALSE(instrumenter_.InstrumentImpl());
+}
+
 }  // namespace instrumenters
 }  // namespace instrument
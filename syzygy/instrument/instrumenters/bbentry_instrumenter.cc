@@ -16,6 +16,7 @@
 
 #include "base/file_util.h"
 #include "base/logging.h"
+#include "base/string_number_conversions.h"
 #include "syzygy/common/application.h"
 #include "syzygy/pe/image_filter.h"
 
@@ -26,7 +27,8 @@ const char BasicBlockEntryInstrumenter::kAgentDllBasicBlockEntry[] =
     "basic_block_entry_client.dll";
 
 BasicBlockEntryInstrumenter::BasicBlockEntryInstrumenter()
-    : inline_fast_path_(false) {
+    : inline_fast_path_(false),
+      frequency_size_(sizeof(uint32)) {
   agent_dll_ = kAgentDllBasicBlockEntry;
 }
 
@@ -35,6 +37,7 @@ bool BasicBlockEntryInstrumenter::InstrumentImpl() {
       new instrument::transforms::BasicBlockEntryHookTransform());
   bbentry_transform_->set_instrument_dll_name(agent_dll_);
   bbentry_transform_->set_inline_fast_path(inline_fast_path_);
+  bbentry_transform_->set_frequency_size(frequency_size_);
   bbentry_transform_->set_src_ranges_for_thunks(debug_friendly_);
   if (!relinker_->AppendTransform(bbentry_transform_.get()))
     return false;
@@ -54,6 +57,17 @@ bool BasicBlockEntryInstrumenter::ParseAdditionalCommandLineArguments(
   // Parse the additional command line arguments.
   inline_fast_path_ = command_line->HasSwitch("inline-fast-path");
 
+  if (command_line->HasSwitch("frequency-size")) {
+    std::string size_str = command_line->GetSwitchValueASCII("frequency-size");
+    size_t size = 0;
+    if (!base::StringToSizeT(size_str, &size) ||
+        (size != 1 && size != 2 && size != 4)) {
+      LOG(ERROR) << "Invalid frequency-size value: " << size_str << ".";
+      return false;
+    }
+    frequency_size_ = static_cast<uint8>(size);
+  }
+
   return true;
 }
 
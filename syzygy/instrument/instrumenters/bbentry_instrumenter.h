@@ -48,6 +48,7 @@ class BasicBlockEntryInstrumenter : public InstrumenterWithAgent {
   // @name Command-line parameters.
   // @{
   bool inline_fast_path_;
+  uint8 frequency_size_;
   // @}
 
   // The transform for this agent.
@@ -37,6 +37,7 @@ class TestBasicBlockEntryInstrumenter : public BasicBlockEntryInstrumenter {
   using BasicBlockEntryInstrumenter::no_parse_debug_info_;
   using BasicBlockEntryInstrumenter::no_strip_strings_;
   using BasicBlockEntryInstrumenter::inline_fast_path_;
+  using BasicBlockEntryInstrumenter::frequency_size_;
   using BasicBlockEntryInstrumenter::debug_friendly_;
   using BasicBlockEntryInstrumenter::kAgentDllBasicBlockEntry;
   using BasicBlockEntryInstrumenter::InstrumentImpl;
@@ -132,6 +133,7 @@ TEST_F(BasicBlockEntryInstrumenterTest, ParseMinimalBasicBlockEntry) {
   EXPECT_FALSE(instrumenter_.no_strip_strings_);
   EXPECT_FALSE(instrumenter_.debug_friendly_);
   EXPECT_FALSE(instrumenter_.inline_fast_path_);
+  EXPECT_EQ(sizeof(uint32), instrumenter_.frequency_size_);
 }
 
 TEST_F(BasicBlockEntryInstrumenterTest, ParseFullBasicBlockEntry) {
@@ -144,6 +146,7 @@ TEST_F(BasicBlockEntryInstrumenterTest, ParseFullBasicBlockEntry) {
   cmd_line_.AppendSwitch("no-parse-debug-info");
   cmd_line_.AppendSwitch("no-strip-strings");
   cmd_line_.AppendSwitch("inline-fast-path");
+  cmd_line_.AppendSwitchASCII("frequency-size", "1");
   cmd_line_.AppendSwitchPath("output-pdb", output_pdb_path_);
   cmd_line_.AppendSwitch("overwrite");
 
@@ -157,12 +160,20 @@ TEST_F(BasicBlockEntryInstrumenterTest, ParseFullBasicBlockEntry) {
   EXPECT_TRUE(instrumenter_.allow_overwrite_);
   EXPECT_TRUE(instrumenter_.new_decomposer_);
   EXPECT_TRUE(instrumenter_.inline_fast_path_);
+  EXPECT_EQ(1U, instrumenter_.frequency_size_);
   EXPECT_TRUE(instrumenter_.no_augment_pdb_);
   EXPECT_TRUE(instrumenter_.no_parse_debug_info_);
   EXPECT_TRUE(instrumenter_.no_strip_strings_);
   EXPECT_TRUE(instrumenter_.debug_friendly_);
 }
 
+TEST_F(BasicBlockEntryInstrumenterTest, ParseInvalidFrequencySize) {
+  SetUpValidCommandLine();
+  cmd_line_.AppendSwitchASCII("frequency-size", "3");
+
+  EXPECT_FALSE(instrumenter_.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(BasicBlockEntryInstrumenterTest, InstrumentImpl) {
   SetUpValidCommandLine();
 
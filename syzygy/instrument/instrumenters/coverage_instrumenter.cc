@@ -24,7 +24,8 @@ namespace instrumenters {
 
 const char CoverageInstrumenter::kAgentDllCoverage[] = "coverage_client.dll";
 
-CoverageInstrumenter::CoverageInstrumenter() {
+CoverageInstrumenter::CoverageInstrumenter()
+    : edge_coverage_(false), page_coverage_(false) {
   agent_dll_ = kAgentDllCoverage;
 }
 
@@ -33,9 +34,15 @@ bool CoverageInstrumenter::InstrumentImpl() {
       new instrument::transforms::CoverageInstrumentationTransform());
   coverage_transform_->set_instrument_dll_name(agent_dll_);
   coverage_transform_->set_src_ranges_for_thunks(debug_friendly_);
+  coverage_transform_->set_edge_coverage(edge_coverage_);
+  coverage_transform_->set_page_coverage(page_coverage_);
   if (!relinker_->AppendTransform(coverage_transform_.get()))
     return false;
 
+  // There are no basic-block ranges to record in page coverage mode.
+  if (page_coverage_)
+    return true;
+
   add_bb_addr_stream_mutator_.reset(
         new instrument::mutators::AddIndexedDataRangesStreamPdbMutator(
             coverage_transform_->bb_ranges(),
@@ -46,5 +53,18 @@ bool CoverageInstrumenter::InstrumentImpl() {
   return true;
 }
 
+bool CoverageInstrumenter::ParseAdditionalCommandLineArguments(
+    const CommandLine* command_line) {
+  // Parse the additional command line arguments.
+  edge_coverage_ = command_line->HasSwitch("edge-coverage");
+  page_coverage_ = command_line->HasSwitch("page-coverage");
+  if (edge_coverage_ && page_coverage_) {
+    LOG(ERROR) << "--edge-coverage and --page-coverage are exclusive.";
+    return false;
+  }
+
+  return true;
+}
+
 }  // namespace instrumenters
 }  // namespace instrument
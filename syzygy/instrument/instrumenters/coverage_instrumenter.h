@@ -40,6 +40,14 @@ class CoverageInstrumenter : public InstrumenterWithAgent {
   // @{
   virtual bool InstrumentImpl() OVERRIDE;
   virtual const char* InstrumentationMode() OVERRIDE { return "coverage"; }
+  virtual bool ParseAdditionalCommandLineArguments(
+      const CommandLine* command_line) OVERRIDE;
+  // @}
+
+  // @name Command-line parameters.
+  // @{
+  bool edge_coverage_;
+  bool page_coverage_;
   // @}
 
   // The transform for this agent.
@@ -37,6 +37,8 @@ class TestCoverageInstrumenter : public CoverageInstrumenter {
   using CoverageInstrumenter::no_parse_debug_info_;
   using CoverageInstrumenter::no_strip_strings_;
   using CoverageInstrumenter::debug_friendly_;
+  using CoverageInstrumenter::edge_coverage_;
+  using CoverageInstrumenter::page_coverage_;
   using CoverageInstrumenter::kAgentDllCoverage;
   using CoverageInstrumenter::InstrumentImpl;
   using InstrumenterWithAgent::CreateRelinker;
@@ -130,12 +132,15 @@ TEST_F(CoverageInstrumenterTest, ParseMinimalCoverage) {
   EXPECT_FALSE(instrumenter_.no_parse_debug_info_);
   EXPECT_FALSE(instrumenter_.no_strip_strings_);
   EXPECT_FALSE(instrumenter_.debug_friendly_);
+  EXPECT_FALSE(instrumenter_.edge_coverage_);
+  EXPECT_FALSE(instrumenter_.page_coverage_);
 }
 
 TEST_F(CoverageInstrumenterTest, ParseFullCoverage) {
   SetUpValidCommandLine();
   cmd_line_.AppendSwitchASCII("agent", "foo.dll");
   cmd_line_.AppendSwitch("debug-friendly");
+  cmd_line_.AppendSwitch("edge-coverage");
   cmd_line_.AppendSwitchPath("input-pdb", input_pdb_path_);
   cmd_line_.AppendSwitch("new-decomposer");
   cmd_line_.AppendSwitch("no-augment-pdb");
@@ -157,6 +162,25 @@ TEST_F(CoverageInstrumenterTest, ParseFullCoverage) {
   EXPECT_TRUE(instrumenter_.no_parse_debug_info_);
   EXPECT_TRUE(instrumenter_.no_strip_strings_);
   EXPECT_TRUE(instrumenter_.debug_friendly_);
+  EXPECT_TRUE(instrumenter_.edge_coverage_);
+  EXPECT_FALSE(instrumenter_.page_coverage_);
+}
+
+TEST_F(CoverageInstrumenterTest, ParsePageCoverage) {
+  SetUpValidCommandLine();
+  cmd_line_.AppendSwitch("page-coverage");
+
+  EXPECT_TRUE(instrumenter_.ParseCommandLine(&cmd_line_));
+  EXPECT_FALSE(instrumenter_.edge_coverage_);
+  EXPECT_TRUE(instrumenter_.page_coverage_);
+}
+
+TEST_F(CoverageInstrumenterTest, ParseEdgeAndPageCoverageFails) {
+  SetUpValidCommandLine();
+  cmd_line_.AppendSwitch("edge-coverage");
+  cmd_line_.AppendSwitch("page-coverage");
+
+  EXPECT_FALSE(instrumenter_.ParseCommandLine(&cmd_line_));
 }
 
 TEST_F(CoverageInstrumenterTest, InstrumentImpl) {
@@ -167,5 +191,14 @@ TEST_F(CoverageInstrumenterTest, InstrumentImpl) {
   EXPECT_TRUE(instrumenter_.InstrumentImpl());
 }
 
+TEST_F(CoverageInstrumenterTest, InstrumentImplPageCoverage) {
+  SetUpValidCommandLine();
+  cmd_line_.AppendSwitch("page-coverage");
+
+  EXPECT_TRUE(instrumenter_.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(instrumenter_.CreateRelinker());
+  EXPECT_TRUE(instrumenter_.InstrumentImpl());
+}
+
 }  // namespace instrumenters
 }  // namespace instrument
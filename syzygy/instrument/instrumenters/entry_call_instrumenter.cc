@@ -14,25 +14,225 @@
 
 #include "syzygy/instrument/instrumenters/entry_call_instrumenter.h"
 
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
 #include "base/file_util.h"
 #include "base/logging.h"
+#include "base/string_number_conversions.h"
+#include "base/string_util.h"
+#include "base/strings/string_split.h"
 #include "syzygy/common/application.h"
 #include "syzygy/pe/image_filter.h"
 
 namespace instrument {
 namespace instrumenters {
 
+namespace {
+
+typedef std::vector<pe::ImageFilter::Range> RangeVector;
+
+// Loads the image filter stored at @p filter_path, and ensures that it's for
+// the module at @p image_path.
+// @param filter_path The path of the filter.
+// @param image_path The path of the module the filter must be for.
+// @param filter Will receive the image filter.
+// @returns true on success, false otherwise.
+bool LoadImageFilter(const base::FilePath& filter_path,
+                     const base::FilePath& image_path,
+                     scoped_ptr<pe::ImageFilter>* filter) {
+  DCHECK(filter != NULL);
+
+  filter->reset(new pe::ImageFilter());
+  if (!(*filter)->LoadFromJSON(filter_path)) {
+    LOG(ERROR) << "Failed to parse filter file: " << filter_path.value();
+    return false;
+  }
+
+  // Ensure it is for the input module.
+  if (!(*filter)->IsForModule(image_path)) {
+    LOG(ERROR) << "Filter does not match the input module.";
+    return false;
+  }
+
+  return true;
+}
+
+// Parses a line of the basic-block heat map output by the sample grinder,
+// which reads "RVA, Size, Compiland, Function, Heat".
+// @param line The line to parse.
+// @param range Will receive the range of the basic block.
+// @param function Will receive the compiland and function names, which
+//     identify the function the basic block belongs to.
+// @param heat Will receive the heat of the basic block.
+// @returns true on success, false otherwise.
+bool ParseHeatMapLine(const std::string& line,
+                      pe::ImageFilter::Range* range,
+                      std::string* function,
+                      double* heat) {
+  DCHECK(range != NULL);
+  DCHECK(function != NULL);
+  DCHECK(heat != NULL);
+
+  // Function names may contain commas, so the heat is found from the end.
+  size_t rva_end = line.find(',');
+  if (rva_end == std::string::npos)
+    return false;
+  size_t size_end = line.find(',', rva_end + 1);
+  size_t heat_begin = line.rfind(',');
+  if (size_end == std::string::npos || heat_begin <= size_end)
+    return false;
+
+  std::string rva_str;
+  std::string size_str;
+  std::string heat_str;
+  TrimWhitespaceASCII(line.substr(0, rva_end), TRIM_ALL, &rva_str);
+  TrimWhitespaceASCII(line.substr(rva_end + 1, size_end - rva_end - 1),
+                      TRIM_ALL, &size_str);
+  TrimWhitespaceASCII(line.substr(heat_begin + 1), TRIM_ALL, &heat_str);
+
+  int rva = 0;
+  int size = 0;
+  if (!base::HexStringToInt(rva_str, &rva) ||
+      !base::StringToInt(size_str, &size) || size <= 0 ||
+      !base::StringToDouble(heat_str, heat)) {
+    return false;
+  }
+
+  *range = pe::ImageFilter::Range(core::RelativeAddress(rva), size);
+  *function = line.substr(size_end + 1, heat_begin - size_end - 1);
+
+  return true;
+}
+
+// Builds an image filter marking the hottest functions of the module at
+// @p image_path, as per the basic-block heat map stored at @p heat_map_path.
+// @param heat_map_path The path of the basic-block heat map, as output in CSV
+//     format by the sample grinder.
+// @param image_path The path of the module the heat map is for.
+// @param hot_heat_percent The percentage of the total heat the marked
+//     functions must account for, starting with the hottest one.
+// @param hot_filter Will receive the image filter.
+// @returns true on success, false otherwise.
+bool LoadHotFunctions(const base::FilePath& heat_map_path,
+                      const base::FilePath& image_path,
+                      double hot_heat_percent,
+                      scoped_ptr<pe::ImageFilter>* hot_filter) {
+  DCHECK_LT(0.0, hot_heat_percent);
+  DCHECK_GE(100.0, hot_heat_percent);
+  DCHECK(hot_filter != NULL);
+
+  hot_filter->reset(new pe::ImageFilter());
+  if (!(*hot_filter)->Init(image_path)) {
+    LOG(ERROR) << "Failed to read module: " << image_path.value();
+    return false;
+  }
+
+  std::string contents;
+  if (!file_util::ReadFileToString(heat_map_path, &contents)) {
+    LOG(ERROR) << "Failed to read heat map: " << heat_map_path.value();
+    return false;
+  }
+  std::vector<std::string> lines;
+  base::SplitString(contents, '\n', &lines);
+
+  // Accumulate the heat and the basic blocks of each function. The first line
+  // is the header.
+  typedef std::pair<double, RangeVector> FunctionHeat;
+  typedef std::map<std::string, FunctionHeat> FunctionHeatMap;
+  FunctionHeatMap function_heat_map;
+  double total_heat = 0.0;
+  for (size_t i = 1; i < lines.size(); ++i) {
+    if (lines[i].empty())
+      continue;
+
+    pe::ImageFilter::Range range;
+    std::string function;
+    double heat = 0.0;
+    if (!ParseHeatMapLine(lines[i], &range, &function, &heat)) {
+      LOG(ERROR) << "Invalid line " << i + 1 << " in heat map: "
+                 << heat_map_path.value();
+      return false;
+    }
+
+    FunctionHeat& function_heat = function_heat_map[function];
+    function_heat.first += heat;
+    function_heat.second.push_back(range);
+    total_heat += heat;
+  }
+
+  // Sort the functions that were sampled by decreasing heat.
+  typedef std::pair<double, const RangeVector*> HeatForFunction;
+  std::vector<HeatForFunction> functions;
+  FunctionHeatMap::const_iterator it = function_heat_map.begin();
+  for (; it != function_heat_map.end(); ++it) {
+    if (it->second.first > 0.0)
+      functions.push_back(std::make_pair(it->second.first, &it->second.second));
+  }
+  std::sort(functions.begin(), functions.end(),
+            std::greater<HeatForFunction>());
+
+  // Mark the hottest functions until they account for enough of the heat.
+  double hot_heat = total_heat * hot_heat_percent / 100.0;
+  double marked_heat = 0.0;
+  size_t num_hot_functions = 0;
+  for (; num_hot_functions < functions.size() && marked_heat < hot_heat;
+       ++num_hot_functions) {
+    const RangeVector& ranges = *functions[num_hot_functions].second;
+    for (size_t j = 0; j < ranges.size(); ++j)
+      (*hot_filter)->filter.Mark(ranges[j]);
+    marked_heat += functions[num_hot_functions].first;
+  }
+
+  LOG(INFO) << "Marked " << num_hot_functions << " of " << functions.size()
+            << " sampled functions as hot.";
+
+  return true;
+}
+
+}  // namespace
+
 const char EntryCallInstrumenter::kAgentDllProfile[] = "profile_client.dll";
+const double EntryCallInstrumenter::kDefaultHotHeatPercent = 95.0;
 
 EntryCallInstrumenter::EntryCallInstrumenter()
-    : thunk_imports_(false) {
+    : hot_heat_percent_(kDefaultHotHeatPercent),
+      min_leaf_instructions_(0),
+      thunk_imports_(false),
+      shadow_stack_(false) {
   agent_dll_ = kAgentDllProfile;
 }
 
 bool EntryCallInstrumenter::InstrumentImpl() {
+  // Parse the filter if one was provided.
+  if (!filter_path_.empty() &&
+      !LoadImageFilter(filter_path_, input_image_path_, &filter_)) {
+    return false;
+  }
+
+  // The hot functions come either from a filter or from a sample run.
+  if (!hot_filter_path_.empty() &&
+      !LoadImageFilter(hot_filter_path_, input_image_path_, &hot_filter_)) {
+    return false;
+  }
+  if (!hot_samples_path_.empty() &&
+      !LoadHotFunctions(hot_samples_path_, input_image_path_,
+                        hot_heat_percent_, &hot_filter_)) {
+    return false;
+  }
+
   entry_thunk_transform_.reset(
       new instrument::transforms::EntryCallTransform(debug_friendly_));
   entry_thunk_transform_->set_instrument_dll_name(agent_dll_);
+  entry_thunk_transform_->set_instrument_exits(shadow_stack_);
+  entry_thunk_transform_->set_min_leaf_instructions(min_leaf_instructions_);
+  if (filter_.get() != NULL)
+    entry_thunk_transform_->set_filter(&filter_->filter);
+  if (hot_filter_.get() != NULL)
+    entry_thunk_transform_->set_hot_filter(&hot_filter_->filter);
   relinker_->AppendTransform(entry_thunk_transform_.get());
 
   // If we are thunking imports then add the appropriate transform.
@@ -50,6 +250,37 @@ bool EntryCallInstrumenter::InstrumentImpl() {
 bool EntryCallInstrumenter::ParseAdditionalCommandLineArguments(
     const CommandLine* command_line) {
   thunk_imports_ = command_line->HasSwitch("instrument-imports");
+  shadow_stack_ = command_line->HasSwitch("shadow-stack");
+  filter_path_ = command_line->GetSwitchValuePath("filter");
+  hot_filter_path_ = command_line->GetSwitchValuePath("hot-filter");
+  hot_samples_path_ = command_line->GetSwitchValuePath("hot-samples");
+
+  if (!hot_filter_path_.empty() && !hot_samples_path_.empty()) {
+    LOG(ERROR) << "--hot-filter and --hot-samples are mutually exclusive.";
+    return false;
+  }
+
+  if (command_line->HasSwitch("hot-heat-percent")) {
+    std::string percent_str =
+        command_line->GetSwitchValueASCII("hot-heat-percent");
+    if (!base::StringToDouble(percent_str, &hot_heat_percent_) ||
+        hot_heat_percent_ <= 0.0 || hot_heat_percent_ > 100.0) {
+      LOG(ERROR) << "Invalid hot-heat-percent value: " << percent_str << ".";
+      return false;
+    }
+  }
+
+  if (command_line->HasSwitch("min-leaf-instructions")) {
+    std::string count_str =
+        command_line->GetSwitchValueASCII("min-leaf-instructions");
+    unsigned count = 0;
+    if (!base::StringToUint(count_str, &count)) {
+      LOG(ERROR) << "Invalid min-leaf-instructions value: " << count_str
+                 << ".";
+      return false;
+    }
+    min_leaf_instructions_ = count;
+  }
 
   return true;
 }
@@ -22,6 +22,7 @@
 #include "syzygy/instrument/instrumenters/instrumenter_with_agent.h"
 #include "syzygy/instrument/transforms/entry_call_transform.h"
 #include "syzygy/instrument/transforms/thunk_import_references_transform.h"
+#include "syzygy/pe/image_filter.h"
 #include "syzygy/pe/pe_relinker.h"
 
 namespace instrument {
@@ -36,6 +37,9 @@ class EntryCallInstrumenter : public InstrumenterWithAgent {
   // The name of the agents for the different mode of instrumentation.
   static const char kAgentDllProfile[];
 
+  // The default percentage of the sampled heat the hot functions account for.
+  static const double kDefaultHotHeatPercent;
+
   // @name InstrumenterWithAgent overrides.
   // @{
   virtual bool InstrumentImpl() OVERRIDE;
@@ -46,9 +50,22 @@ class EntryCallInstrumenter : public InstrumenterWithAgent {
 
   // @name Command-line parameters.
   // @{
+  base::FilePath filter_path_;
+  base::FilePath hot_filter_path_;
+  base::FilePath hot_samples_path_;
+  double hot_heat_percent_;
+  size_t min_leaf_instructions_;
   bool thunk_imports_;
+  bool shadow_stack_;
   // @}
 
+  // The image filter marking the functions not to instrument (optional).
+  scoped_ptr<pe::ImageFilter> filter_;
+
+  // The image filter marking the hot functions, which are instrumented along
+  // with their callers only (optional).
+  scoped_ptr<pe::ImageFilter> hot_filter_;
+
   // The transforms for this agent.
   scoped_ptr<instrument::transforms::EntryCallTransform>
       entry_thunk_transform_;
@@ -15,6 +15,7 @@
 #include "syzygy/instrument/instrumenters/entry_call_instrumenter.h"
 
 #include "base/command_line.h"
+#include "base/file_util.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
 #include "syzygy/pe/unittest_util.h"
@@ -37,6 +38,15 @@ class TestEntryCallInstrumenter : public EntryCallInstrumenter {
   using EntryCallInstrumenter::no_parse_debug_info_;
   using EntryCallInstrumenter::no_strip_strings_;
   using EntryCallInstrumenter::thunk_imports_;
+  using EntryCallInstrumenter::shadow_stack_;
+  using EntryCallInstrumenter::filter_path_;
+  using EntryCallInstrumenter::hot_filter_path_;
+  using EntryCallInstrumenter::hot_samples_path_;
+  using EntryCallInstrumenter::hot_heat_percent_;
+  using EntryCallInstrumenter::min_leaf_instructions_;
+  using EntryCallInstrumenter::filter_;
+  using EntryCallInstrumenter::hot_filter_;
+  using EntryCallInstrumenter::kDefaultHotHeatPercent;
   using EntryCallInstrumenter::debug_friendly_;
   using EntryCallInstrumenter::kAgentDllProfile;
   using EntryCallInstrumenter::InstrumentImpl;
@@ -181,6 +191,13 @@ TEST_F(EntryCallInstrumenterTest, ParseMinimalProfile) {
   EXPECT_FALSE(instrumenter_->no_strip_strings_);
   EXPECT_FALSE(instrumenter_->debug_friendly_);
   EXPECT_FALSE(instrumenter_->thunk_imports_);
+  EXPECT_FALSE(instrumenter_->shadow_stack_);
+  EXPECT_TRUE(instrumenter_->filter_path_.empty());
+  EXPECT_TRUE(instrumenter_->hot_filter_path_.empty());
+  EXPECT_TRUE(instrumenter_->hot_samples_path_.empty());
+  EXPECT_EQ(TestEntryCallInstrumenter::kDefaultHotHeatPercent,
+            instrumenter_->hot_heat_percent_);
+  EXPECT_EQ(0U, instrumenter_->min_leaf_instructions_);
 }
 
 TEST_F(EntryCallInstrumenterTest, ParseFullProfile) {
@@ -196,6 +213,11 @@ TEST_F(EntryCallInstrumenterTest, ParseFullProfile) {
   cmd_line_.AppendSwitchPath("output-pdb", output_pdb_path_);
   cmd_line_.AppendSwitch("overwrite");
   cmd_line_.AppendSwitch("instrument-imports");
+  cmd_line_.AppendSwitch("shadow-stack");
+  cmd_line_.AppendSwitchPath("filter", base::FilePath(L"filter.json"));
+  cmd_line_.AppendSwitchPath("hot-samples", base::FilePath(L"heat.csv"));
+  cmd_line_.AppendSwitchASCII("hot-heat-percent", "80");
+  cmd_line_.AppendSwitchASCII("min-leaf-instructions", "8");
 
   EXPECT_TRUE(instrumenter_->ParseCommandLine(&cmd_line_));
 
@@ -211,6 +233,28 @@ TEST_F(EntryCallInstrumenterTest, ParseFullProfile) {
   EXPECT_TRUE(instrumenter_->no_strip_strings_);
   EXPECT_TRUE(instrumenter_->debug_friendly_);
   EXPECT_TRUE(instrumenter_->thunk_imports_);
+  EXPECT_TRUE(instrumenter_->shadow_stack_);
+  EXPECT_EQ(base::FilePath(L"filter.json"), instrumenter_->filter_path_);
+  EXPECT_EQ(base::FilePath(L"heat.csv"), instrumenter_->hot_samples_path_);
+  EXPECT_EQ(80.0, instrumenter_->hot_heat_percent_);
+  EXPECT_EQ(8U, instrumenter_->min_leaf_instructions_);
+}
+
+TEST_F(EntryCallInstrumenterTest, ParseHotFilterAndHotSamplesFails) {
+  SetUpValidCommandLine();
+  instrumenter_.reset(new TestEntryCallInstrumenter());
+  cmd_line_.AppendSwitchPath("hot-filter", base::FilePath(L"filter.json"));
+  cmd_line_.AppendSwitchPath("hot-samples", base::FilePath(L"heat.csv"));
+
+  EXPECT_FALSE(instrumenter_->ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(EntryCallInstrumenterTest, ParseInvalidHotHeatPercentFails) {
+  SetUpValidCommandLine();
+  instrumenter_.reset(new TestEntryCallInstrumenter());
+  cmd_line_.AppendSwitchASCII("hot-heat-percent", "101");
+
+  EXPECT_FALSE(instrumenter_->ParseCommandLine(&cmd_line_));
 }
 
 TEST_F(EntryCallInstrumenterTest, InstrumentImplCallTrace) {
@@ -231,5 +275,38 @@ TEST_F(EntryCallInstrumenterTest, InstrumentImplProfile) {
   EXPECT_TRUE(instrumenter_->InstrumentImpl());
 }
 
+TEST_F(EntryCallInstrumenterTest, InstrumentImplProfileWithHotSamples) {
+  // A heat map with a hot function spanning two basic blocks, a cooler one,
+  // and one that was never sampled.
+  base::FilePath heat_map_path = temp_dir_.Append(L"heat.csv");
+  const char kHeatMap[] =
+      "RVA, Size, Compiland, Function, Heat\n"
+      "0x00001000, 16, foo.obj, Hot<int, char>, 5.0000000000e-001\n"
+      "0x00001010, 8, foo.obj, Hot<int, char>, 4.0000000000e-001\n"
+      "0x00001020, 32, foo.obj, Cool, 1.0000000000e-001\n"
+      "0x00001040, 32, bar.obj, Cold, 0.0000000000e+000\n";
+  ASSERT_EQ(static_cast<int>(sizeof(kHeatMap) - 1),
+            file_util::WriteFile(heat_map_path, kHeatMap,
+                                 sizeof(kHeatMap) - 1));
+
+  SetUpValidCommandLine();
+  cmd_line_.AppendSwitchPath("hot-samples", heat_map_path);
+  cmd_line_.AppendSwitchASCII("hot-heat-percent", "85");
+  instrumenter_.reset(new TestEntryCallInstrumenter());
+
+  EXPECT_TRUE(instrumenter_->ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(instrumenter_->CreateRelinker());
+  EXPECT_TRUE(instrumenter_->InstrumentImpl());
+
+  // The hot function alone accounts for 85% of the heat.
+  ASSERT_TRUE(instrumenter_->hot_filter_.get() != NULL);
+  typedef pe::ImageFilter::Range Range;
+  const pe::ImageFilter& hot_filter = *instrumenter_->hot_filter_;
+  EXPECT_TRUE(hot_filter.filter.IsMarked(
+      Range(core::RelativeAddress(0x1000), 24)));
+  EXPECT_TRUE(hot_filter.filter.IsUnmarked(
+      Range(core::RelativeAddress(0x1020), 64)));
+}
+
 }  // namespace instrumenters
 }  // namespace instrument
@@ -29,6 +29,7 @@ EntryThunkInstrumenter::EntryThunkInstrumenter(Mode instrumentation_mode)
     : instrumentation_mode_(instrumentation_mode),
       instrument_unsafe_references_(false),
       module_entry_only_(false),
+      pack_thunks_(false),
       thunk_imports_(false) {
   DCHECK(instrumentation_mode != INVALID_MODE);
   switch (instrumentation_mode) {
@@ -56,6 +57,7 @@ bool EntryThunkInstrumenter::InstrumentImpl() {
       instrument_unsafe_references_);
   entry_thunk_transform_->set_src_ranges_for_thunks(debug_friendly_);
   entry_thunk_transform_->set_only_instrument_module_entry(module_entry_only_);
+  entry_thunk_transform_->set_pack_thunks(pack_thunks_);
   if (!relinker_->AppendTransform(entry_thunk_transform_.get()))
     return false;
 
@@ -78,6 +80,7 @@ bool EntryThunkInstrumenter::ParseAdditionalCommandLineArguments(
     module_entry_only_ = command_line->HasSwitch("module-entry-only");
     instrument_unsafe_references_ = !command_line->HasSwitch("no-unsafe-refs");
   }
+  pack_thunks_ = command_line->HasSwitch("pack-thunks");
   thunk_imports_ = command_line->HasSwitch("instrument-imports");
 
   return true;
@@ -60,6 +60,7 @@ class EntryThunkInstrumenter : public InstrumenterWithAgent {
   // @{
   bool instrument_unsafe_references_;
   bool module_entry_only_;
+  bool pack_thunks_;
   bool thunk_imports_;
   // @}
 
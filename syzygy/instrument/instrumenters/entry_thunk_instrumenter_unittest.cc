@@ -38,6 +38,7 @@ class TestEntryThunkInstrumenter : public EntryThunkInstrumenter {
   using EntryThunkInstrumenter::no_strip_strings_;
   using EntryThunkInstrumenter::instrument_unsafe_references_;
   using EntryThunkInstrumenter::module_entry_only_;
+  using EntryThunkInstrumenter::pack_thunks_;
   using EntryThunkInstrumenter::thunk_imports_;
   using EntryThunkInstrumenter::debug_friendly_;
   using EntryThunkInstrumenter::instrumentation_mode_;
@@ -142,6 +143,7 @@ TEST_F(EntryThunkInstrumenterTest, ParseMinimalCallTrace) {
   EXPECT_FALSE(instrumenter_->thunk_imports_);
   EXPECT_TRUE(instrumenter_->instrument_unsafe_references_);
   EXPECT_FALSE(instrumenter_->module_entry_only_);
+  EXPECT_FALSE(instrumenter_->pack_thunks_);
 }
 
 TEST_F(EntryThunkInstrumenterTest, ParseFullCallTrace) {
@@ -161,6 +163,7 @@ TEST_F(EntryThunkInstrumenterTest, ParseFullCallTrace) {
   cmd_line_.AppendSwitch("instrument-imports");
   cmd_line_.AppendSwitch("module-entry-only");
   cmd_line_.AppendSwitch("no-unsafe-refs");
+  cmd_line_.AppendSwitch("pack-thunks");
 
   EXPECT_TRUE(instrumenter_->ParseCommandLine(&cmd_line_));
 
@@ -180,6 +183,7 @@ TEST_F(EntryThunkInstrumenterTest, ParseFullCallTrace) {
   EXPECT_TRUE(instrumenter_->thunk_imports_);
   EXPECT_FALSE(instrumenter_->instrument_unsafe_references_);
   EXPECT_TRUE(instrumenter_->module_entry_only_);
+  EXPECT_TRUE(instrumenter_->pack_thunks_);
 }
 
 TEST_F(EntryThunkInstrumenterTest, ParseMinimalProfile) {
@@ -206,6 +210,7 @@ TEST_F(EntryThunkInstrumenterTest, ParseMinimalProfile) {
   EXPECT_FALSE(instrumenter_->thunk_imports_);
   EXPECT_FALSE(instrumenter_->instrument_unsafe_references_);
   EXPECT_FALSE(instrumenter_->module_entry_only_);
+  EXPECT_FALSE(instrumenter_->pack_thunks_);
 }
 
 TEST_F(EntryThunkInstrumenterTest, ParseFullProfile) {
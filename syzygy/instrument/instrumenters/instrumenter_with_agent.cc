@@ -147,6 +147,21 @@ bool InstrumenterWithAgent::Instrument() {
   return true;
 }
 
+bool InstrumenterWithAgent::InstrumentCoffRelinker(
+    pe::CoffRelinker* relinker) {
+  DCHECK(relinker != NULL);
+
+  image_format_ = pe::COFF_IMAGE;
+  if (!ImageFormatIsSupported(image_format_)) {
+    LOG(ERROR) << "Instrumenter \"" << InstrumentationMode()
+               << "\" does not support COFF object files.";
+    return false;
+  }
+
+  relinker_ = relinker;
+  return InstrumentImpl();
+}
+
 bool InstrumenterWithAgent::ImageFormatIsSupported(
     pe::ImageFormat image_format) {
   // By default we only support PE images.
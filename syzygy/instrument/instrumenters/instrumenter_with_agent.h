@@ -50,6 +50,16 @@ class InstrumenterWithAgent : public InstrumenterInterface {
   virtual bool Instrument() OVERRIDE;
   // @}
 
+  // Instruments a COFF object file through a relinker that is owned by the
+  // caller, rather than through one of its own. This is used to instrument
+  // the object files relinked by a pe::CoffBatchRelinker.
+  // @param relinker the initialized relinker of the object file given on the
+  //     parsed command-line.
+  // @returns true on success, false otherwise.
+  // @note The instrumenter must outlive the relinking of the object file, as
+  //     the relinker refers to its transforms.
+  bool InstrumentCoffRelinker(pe::CoffRelinker* relinker);
+
   // @name Accessors.
   // @
   const std::string& agent_dll() {
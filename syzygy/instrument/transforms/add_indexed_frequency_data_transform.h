@@ -58,6 +58,20 @@ class AddIndexedFrequencyDataTransform
     return frequency_data_buffer_block_;
   }
 
+  // @name Overrides of the construction parameters. These must be called
+  //     prior to applying the transform.
+  // @{
+  void set_data_type(IndexedFrequencyData::DataType data_type) {
+    DCHECK(frequency_data_block_ == NULL);
+    data_type_ = data_type;
+  }
+  void set_indexed_frequency_data_size(size_t size) {
+    DCHECK(frequency_data_block_ == NULL);
+    DCHECK_LE(sizeof(IndexedFrequencyData), size);
+    frequency_data_block_size_ = size;
+  }
+  // @}
+
   // BlockGraphTransformInterface Implementation.
   virtual bool TransformBlockGraph(const TransformPolicyInterface* policy,
                                    BlockGraph* block_graph,
@@ -14,17 +14,22 @@
 
 #include "syzygy/instrument/transforms/asan_transform.h"
 
+#include <algorithm>
 #include <vector>
 
 #include "base/logging.h"
 #include "base/string_util.h"
 #include "base/stringprintf.h"
 #include "base/memory/ref_counted.h"
+#include "syzygy/agent/basic_block_entry/basic_block_entry.h"
+#include "syzygy/block_graph/analysis/control_flow_analysis.h"
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/basic_block_assembler.h"
 #include "syzygy/block_graph/block_builder.h"
 #include "syzygy/block_graph/block_util.h"
 #include "syzygy/common/defs.h"
+#include "syzygy/common/indexed_frequency_data.h"
+#include "syzygy/instrument/transforms/entry_thunk_transform.h"
 #include "syzygy/pe/block_util.h"
 #include "syzygy/pe/pe_utils.h"
 #include "third_party/distorm/files/include/mnemonics.h"
@@ -34,6 +39,7 @@ namespace instrument {
 namespace transforms {
 namespace {
 
+using block_graph::ApplyBlockGraphTransform;
 using block_graph::BasicBlock;
 using block_graph::BasicCodeBlock;
 using block_graph::BasicBlockAssembler;
@@ -45,6 +51,7 @@ using block_graph::Displacement;
 using block_graph::Immediate;
 using block_graph::Instruction;
 using block_graph::Operand;
+using block_graph::Successor;
 using block_graph::TransformPolicyInterface;
 using block_graph::TypedBlock;
 using block_graph::Value;
@@ -65,6 +72,12 @@ typedef std::vector<AsanBasicBlockTransform::AsanHookMapEntryKey>
     AccessHookParamVector;
 typedef TypedBlock<IMAGE_IMPORT_DESCRIPTOR> ImageImportDescriptor;
 typedef TypedBlock<StringStruct> String;
+typedef agent::basic_block_entry::BasicBlockEntry::
+    BasicBlockIndexedFrequencyData BasicBlockIndexedFrequencyData;
+
+// The log of the number of bytes covered by each shadow byte. This mirrors
+// agent::asan::Shadow::kShadowGranularityLog.
+const uint8 kShadowGranularityLog = 3;
 
 // Returns true iff opcode should be instrumented.
 bool ShouldInstrumentOpcode(uint16 opcode) {
@@ -87,6 +100,30 @@ bool ShouldInstrumentOpcode(uint16 opcode) {
   return true;
 }
 
+// Returns true iff the memory access performed by @p instr should be
+// instrumented when only a fraction of the accesses are. The accesses are
+// selected by hashing their address in the original image, so that the same
+// accesses get selected for a given seed.
+// @param instr The instruction performing the access.
+// @param seed The seed to hash the address with.
+// @param rate The fraction of the accesses to select, in [0, 1].
+bool IsSampled(const Instruction& instr, uint32 seed, double rate) {
+  if (rate >= 1.0)
+    return true;
+
+  // This is the finalizer of MurmurHash3, which mixes the bits of the
+  // addresses well enough for neighbouring accesses to be selected
+  // independently.
+  uint32 hash = instr.source_range().start().value() ^ seed;
+  hash ^= hash >> 16;
+  hash *= 0x85EBCA6B;
+  hash ^= hash >> 13;
+  hash *= 0xC2B2AE35;
+  hash ^= hash >> 16;
+
+  return static_cast<double>(hash) < rate * 4294967296.0;
+}
+
 // Computes the correct displacement, if any, for operand
 // number @p operand of @p instr.
 Displacement ComputeDisplacementForOperand(const Instruction& instr,
@@ -265,8 +302,10 @@ void InjectAsanHook(BasicBlockAssembler* bb_asm,
   if (info.mode == AsanBasicBlockTransform::kReadAccess ||
       info.mode == AsanBasicBlockTransform::kWriteAccess) {
     // The standard load/store probe assume the address is in EDX.
-    // It restore the original version of EDX and cleanup the stack.
-    bb_asm->push(core::edx);
+    // It restore the original version of EDX and cleanup the stack, unless
+    // EDX is dead, in which case there's nothing to save in the first place.
+    if (!info.clobber_edx)
+      bb_asm->push(core::edx);
     bb_asm->lea(core::edx, op);
     bb_asm->call(Operand(Displacement(hook->referenced(), hook->offset())));
   } else {
@@ -276,6 +315,54 @@ void InjectAsanHook(BasicBlockAssembler* bb_asm,
   }
 }
 
+// Use @p bb_asm to inject the inlined fast path of the check of the access to
+// the address stored in the operand @p op. This tests the shadow byte of the
+// access, leaving the zero flag cleared iff the hook must be called.
+// @param bb_asm The assembler used to inject the fast path.
+// @param info The memory access information. The flags must be dead.
+// @param op The operand of the access.
+// @param shadow_memory The reference to the shadow memory import entry.
+void InjectAsanFastPath(BasicBlockAssembler* bb_asm,
+                        const AsanBasicBlockTransform::MemoryAccessInfo& info,
+                        const Operand& op,
+                        const BlockGraph::Reference& shadow_memory) {
+  DCHECK(bb_asm != NULL);
+  DCHECK(!info.save_flags);
+
+  // The shadow only covers the lower 2GB of the address space. As the
+  // instrumented images aren't large address aware, accesses above it fault
+  // regardless of what's read in place of their shadow byte.
+  if (!info.clobber_edx)
+    bb_asm->push(core::edx);
+  bb_asm->lea(core::edx, op);
+  bb_asm->shr(core::edx, Immediate(kShadowGranularityLog, core::kSize8Bit));
+  // The runtime reserves the shadow memory when it's set up, so its export is
+  // a pointer to the shadow memory. The shadow index is set aside on the stack
+  // while that pointer is loaded.
+  bb_asm->push(core::edx);
+  bb_asm->mov(core::edx, Operand(Displacement(shadow_memory.referenced(),
+                                              shadow_memory.offset())));
+  bb_asm->mov(core::edx, Operand(core::edx));
+  bb_asm->add(Operand(core::esp), core::edx);
+  bb_asm->pop(core::edx);
+  bb_asm->movzx_b(core::edx, Operand(core::edx));
+  bb_asm->test(core::dl, core::dl);
+  if (!info.clobber_edx)
+    bb_asm->pop(core::edx);
+}
+
+// Appends a successor to @p to, taken under @p condition, to @p from.
+void AddSuccessorBetween(Successor::Condition condition,
+                         BasicCodeBlock* from,
+                         BasicCodeBlock* to) {
+  from->successors().push_back(
+      Successor(condition,
+                BasicBlockReference(BlockGraph::RELATIVE_REF,
+                                    BlockGraph::Reference::kMaximumSize,
+                                    to),
+                0));
+}
+
 typedef std::pair<BlockGraph::Block*, BlockGraph::Offset> ReferenceDest;
 typedef std::map<ReferenceDest, ReferenceDest> ReferenceMap;
 typedef std::set<BlockGraph::Block*> BlockSet;
@@ -350,15 +437,47 @@ std::string GetAsanCheckAccessFunctionName(
     access_mode_str = reinterpret_cast<char*>(GET_MNEMONIC_NAME(info.opcode));
 
   std::string function_name =
-      base::StringPrintf("asan_check%s_%d_byte_%s_access%s",
+      base::StringPrintf("asan_check%s_%d_byte_%s_access%s%s",
                           rep_str,
                           info.size,
                           access_mode_str,
+                          info.clobber_edx ? "_no_edx" : "",
                           info.save_flags ? "" : "_no_flags");
   StringToLowerASCII(&function_name);
   return function_name;
 }
 
+// Adds the parameters of the read and write access hooks of a given size to
+// @p hook_param_vector. When the liveness analysis is used, this includes the
+// variants that preserve neither the flags nor EDX, or only one of them.
+// @param access_size The size of the accesses.
+// @param use_liveness_analysis True iff the liveness analysis is used.
+// @param hook_param_vector The vector receiving the hook parameters.
+void AddReadWriteAccessHookParams(int access_size,
+                                  bool use_liveness_analysis,
+                                  AccessHookParamVector* hook_param_vector) {
+  DCHECK(hook_param_vector != NULL);
+
+  const AsanMemoryAccessMode kModes[] = {
+      AsanBasicBlockTransform::kReadAccess,
+      AsanBasicBlockTransform::kWriteAccess };
+
+  for (size_t i = 0; i < arraysize(kModes); ++i) {
+    AsanBasicBlockTransform::MemoryAccessInfo info =
+        { kModes[i], access_size, 0, true, false };
+    hook_param_vector->push_back(info);
+    if (!use_liveness_analysis)
+      continue;
+
+    info.save_flags = false;
+    hook_param_vector->push_back(info);
+    info.clobber_edx = true;
+    hook_param_vector->push_back(info);
+    info.save_flags = true;
+    hook_param_vector->push_back(info);
+  }
+}
+
 // Add the imports for the asan check access hooks to the block-graph.
 // @param hooks_param_vector A vector of hook parameter values.
 // @param default_stub_map Stubs for the asan check access functions.
@@ -431,8 +550,14 @@ bool AddAsanCheckAccessHooks(
     // until the Asan imports are resolved. To do this we need to make the IAT
     // entries for those functions point to a temporarily block and we need to
     // mark the image import descriptor for this DLL as bound.
+    // The hooks that don't preserve EDX don't clean up the stack either, so
+    // they share the plain return stub of the special instructions hooks.
+    AsanBasicBlockTransform::MemoryAccessMode stub_mode =
+        iter_hooks->first.mode;
+    if (iter_hooks->first.clobber_edx)
+      stub_mode = AsanBasicBlockTransform::kInstrAccess;
     AsanBasicBlockTransform::AsanDefaultHookMap::const_iterator stub_reference =
-        default_stub_map.find(iter_hooks->first.mode);
+        default_stub_map.find(stub_mode);
     if (stub_reference == default_stub_map.end()) {
        LOG(ERROR) << "Could not find the default hook for "
                   << GetAsanCheckAccessFunctionName(iter_hooks->first)
@@ -518,6 +643,13 @@ bool CreateHooksStub(BlockGraph* block_graph,
 const char AsanBasicBlockTransform::kTransformName[] =
     "SyzyAsanBasicBlockTransform";
 
+void AsanBasicBlockTransform::set_instrumentation_rate(
+    double instrumentation_rate) {
+  DCHECK_LE(0.0, instrumentation_rate);
+  DCHECK_GE(1.0, instrumentation_rate);
+  instrumentation_rate_ = instrumentation_rate;
+}
+
 bool AsanBasicBlockTransform::InstrumentBasicBlock(
     BasicCodeBlock* basic_block, StackAccessMode stack_mode) {
   DCHECK(basic_block != NULL);
@@ -546,6 +678,10 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
   if (remove_redundant_checks_)
     memory_accesses_.GetStateAtEntryOf(basic_block, &memory_state);
 
+  // The hottest basic blocks get the cheapest instrumentation.
+  bool is_hot = hot_filter_ != NULL &&
+      block_graph::IsFiltered(*hot_filter_, basic_block);
+
   // Process each instruction and inject a call to Asan when we find an
   // instrumentable memory access.
   BasicBlock::Instructions::iterator iter_inst =
@@ -561,6 +697,7 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
     info.size = 0;
     info.opcode = 0;
     info.save_flags = true;
+    info.clobber_edx = false;
 
     // Get current instruction liveness information.
     if (use_liveness_analysis_) {
@@ -589,46 +726,56 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
     if (info.mode == kNoAccess)
       continue;
 
-    // A basic block reference means that can be either a computed jump,
-    // or a load from a case table. In either case it doesn't make sense
-    // to instrument the access.
-    if (operand.displacement().reference().referred_type() ==
-        BasicBlockReference::REFERRED_TYPE_BASIC_BLOCK) {
-      continue;
-    }
-
-    // A block reference means this instruction is reading or writing to
-    // a global variable or some such. It's viable to pad and align global
-    // variables and to red-zone the padding, but without that, there's nothing
-    // to gain by instrumenting these accesses.
-    if (operand.displacement().reference().referred_type() ==
-        BasicBlockReference::REFERRED_TYPE_BLOCK) {
-      continue;
-    }
-
     // Is this an instruction we should be instrumenting.
     if (!ShouldInstrumentOpcode(repr.opcode))
       continue;
 
-    // If there are no unconventional manipulations of the stack frame, we can
-    // skip instrumenting stack-based memory access (based on ESP or EBP).
-    // Conventionally, accesses through ESP/EBP are always on stack.
-    if (stack_mode == kSafeStackAccess &&
-        (operand.base() == core::kRegisterEsp ||
-         operand.base() == core::kRegisterEbp)) {
+    // Elide the checks of the accesses that can't touch the heap.
+    SafeAccessKind safe_access_kind = ClassifyAccess(operand, repr, stack_mode);
+    if (safe_access_kind != kUnsafeAccess) {
+      switch (safe_access_kind) {
+        case kImageAccess:
+          ++stats_.num_image_elided;
+          break;
+        case kStackAccess:
+          ++stats_.num_stack_elided;
+          break;
+        case kSegmentAccess:
+          ++stats_.num_segment_elided;
+          break;
+        default:
+          NOTREACHED();
+      }
       continue;
     }
 
-    // We do not instrument memory accesses through special segments.
-    // FS is used for thread local specifics and GS for CPU info.
-    uint8_t segment = SEGMENT_GET(repr.segment);
-    if (segment == R_FS || segment == R_GS)
-      continue;
-
     // Finally, don't instrument any filtered instructions.
     if (IsFiltered(*iter_inst))
       continue;
 
+    // Nor those left out when only instrumenting a fraction of the accesses.
+    if (!IsSampled(instr, instrumentation_seed_, instrumentation_rate_))
+      continue;
+
+    // When the access is loop-invariant, or more generally redundant along
+    // some of the paths reaching this basic block, check it at the end of the
+    // other predecessors instead. These are instrumented once all the basic
+    // blocks are, as they may not have been visited yet.
+    MemoryAccessAnalysis::BasicCodeBlockVector predecessors;
+    if (remove_redundant_checks_ && hoist_invariant_checks_ &&
+        (info.mode == kReadAccess || info.mode == kWriteAccess) &&
+        memory_accesses_.IsPartiallyRedundant(basic_block, instr,
+                                              &predecessors)) {
+      size_t counter_index = AddCheckSite(instr.source_range());
+      for (size_t i = 0; i < predecessors.size(); ++i) {
+        hoisted_checks_.push_back(HoistedCheck(
+            predecessors[i], info, operand, instr.source_range(),
+            counter_index));
+      }
+      stats_.num_emitted += predecessors.size();
+      continue;
+    }
+
     // Create a BasicBlockAssembler to insert new instruction.
     BasicBlockAssembler bb_asm(iter_inst, &basic_block->instructions());
 
@@ -641,8 +788,25 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
 
     if (use_liveness_analysis_ &&
         (info.mode == kReadAccess || info.mode == kWriteAccess)) {
-      // Use the liveness information to skip saving the flags if possible.
+      // Use the liveness information to skip saving the flags and EDX if
+      // possible.
       info.save_flags = state.AreArithmeticFlagsLive();
+      info.clobber_edx = !state.IsLive(core::edx);
+    }
+
+    // The fast path can only be inlined where the flags are dead, as it
+    // doesn't preserve them. As this splits the basic block, it's deferred
+    // until all the other accesses are instrumented.
+    bool inline_access = is_hot || (inline_fast_path_ &&
+        (inline_filter_ == NULL ||
+         block_graph::IsFiltered(*inline_filter_, instr)));
+    if (inline_access && use_liveness_analysis_ && !info.save_flags &&
+        (info.mode == kReadAccess || info.mode == kWriteAccess)) {
+      inline_checks_.push_back(
+          InlineCheck(basic_block, iter_inst, info, operand,
+                      AddCheckSite(instr.source_range())));
+      ++stats_.num_emitted;
+      continue;
     }
 
     // Insert hook for standard instructions.
@@ -653,7 +817,9 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
     }
 
     // Instrument this instruction.
+    InjectCheckCounter(&bb_asm, AddCheckSite(instr.source_range()));
     InjectAsanHook(&bb_asm, info, operand, &hook->second, state);
+    ++stats_.num_emitted;
   }
 
   DCHECK(iter_state == states.end());
@@ -661,6 +827,178 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
   return true;
 }
 
+size_t AsanBasicBlockTransform::AddCheckSite(
+    const Instruction::SourceRange& source_range) {
+  if (check_sites_ == NULL)
+    return 0;
+
+  check_sites_->push_back(
+      RelativeAddressRange(source_range.start(), source_range.size()));
+  return check_sites_->size() - 1;
+}
+
+void AsanBasicBlockTransform::InjectCheckCounter(BasicBlockAssembler* bb_asm,
+                                                 size_t counter_index) {
+  DCHECK(bb_asm != NULL);
+  if (check_sites_ == NULL)
+    return;
+
+  DCHECK(check_counter_hook_.IsValid());
+  DCHECK_LT(counter_index, check_sites_->size());
+
+  // The hook preserves the registers and the flags, and pops its arguments.
+  bb_asm->push(Immediate(counter_index, core::kSize32Bit));
+  bb_asm->push(Immediate(check_counter_data_, 0));
+  bb_asm->call(Operand(Displacement(check_counter_hook_.referenced(),
+                                    check_counter_hook_.offset())));
+}
+
+bool AsanBasicBlockTransform::InstrumentHoistedChecks() {
+  for (size_t i = 0; i < hoisted_checks_.size(); ++i) {
+    HoistedCheck& check = hoisted_checks_[i];
+    BasicBlock::Instructions& instructions = check.basic_block->instructions();
+
+    // The check is performed after the last instruction of the predecessor,
+    // hence the liveness information is the one at its exit.
+    LivenessAnalysis::State state;
+    if (use_liveness_analysis_) {
+      liveness_.GetStateAtExitOf(check.basic_block, &state);
+      check.info.save_flags = state.AreArithmeticFlagsLive();
+      check.info.clobber_edx = !state.IsLive(core::edx);
+    }
+
+    AsanHookMap::iterator hook = check_access_hooks_->find(check.info);
+    if (hook == check_access_hooks_->end()) {
+      LOG(ERROR) << "Invalid access : "
+                 << GetAsanCheckAccessFunctionName(check.info);
+      return false;
+    }
+
+    BasicBlockAssembler bb_asm(instructions.end(), &instructions);
+    if (debug_friendly_)
+      bb_asm.set_source_range(check.source_range);
+    InjectCheckCounter(&bb_asm, check.counter_index);
+    InjectAsanHook(&bb_asm, check.info, check.operand, &hook->second, state);
+  }
+
+  hoisted_checks_.clear();
+  return true;
+}
+
+bool AsanBasicBlockTransform::InstrumentInlineChecks(
+    BasicBlockSubGraph* subgraph) {
+  DCHECK(subgraph != NULL);
+
+  // The checks are instrumented starting from the last one, so that splitting
+  // a basic block leaves the accesses preceding the split in it.
+  InlineChecks::reverse_iterator check = inline_checks_.rbegin();
+  for (; check != inline_checks_.rend(); ++check) {
+    DCHECK(shadow_memory_.IsValid());
+    BasicCodeBlock* head = check->basic_block;
+
+    AsanHookMap::iterator hook = check_access_hooks_->find(check->info);
+    if (hook == check_access_hooks_->end()) {
+      LOG(ERROR) << "Invalid access : "
+                 << GetAsanCheckAccessFunctionName(check->info);
+      return false;
+    }
+
+    // Find the ordering the basic block belongs to.
+    BasicBlockSubGraph::BasicBlockOrdering* order = NULL;
+    BasicBlockSubGraph::BasicBlockOrdering::iterator position;
+    BasicBlockSubGraph::BlockDescriptionList::iterator desc =
+        subgraph->block_descriptions().begin();
+    for (; desc != subgraph->block_descriptions().end(); ++desc) {
+      position = std::find(desc->basic_block_order.begin(),
+                           desc->basic_block_order.end(),
+                           head);
+      if (position != desc->basic_block_order.end()) {
+        order = &desc->basic_block_order;
+        break;
+      }
+    }
+    DCHECK(order != NULL);
+
+    // Move the access and the instructions following it to a new basic block,
+    // which takes over the successors. It's laid out right after the access'
+    // basic block, while the slow path is laid out out of line.
+    BasicCodeBlock* tail = subgraph->AddBasicCodeBlock(head->name());
+    BasicCodeBlock* slow_path = subgraph->AddBasicCodeBlock(head->name());
+    DCHECK(tail != NULL);
+    DCHECK(slow_path != NULL);
+    tail->instructions().splice(tail->instructions().end(),
+                                head->instructions(),
+                                check->instruction,
+                                head->instructions().end());
+    tail->successors().swap(head->successors());
+    order->insert(++position, tail);
+    order->push_back(slow_path);
+
+    BasicBlockAssembler fast_asm(head->instructions().end(),
+                                 &head->instructions());
+    BasicBlockAssembler slow_asm(slow_path->instructions().end(),
+                                 &slow_path->instructions());
+    if (debug_friendly_) {
+      fast_asm.set_source_range(check->instruction->source_range());
+      slow_asm.set_source_range(check->instruction->source_range());
+    }
+
+    InjectCheckCounter(&fast_asm, check->counter_index);
+    InjectAsanFastPath(&fast_asm, check->info, check->operand, shadow_memory_);
+    InjectAsanHook(&slow_asm, check->info, check->operand, &hook->second,
+                   LivenessAnalysis::State());
+
+    AddSuccessorBetween(Successor::kConditionNotEqual, head, slow_path);
+    AddSuccessorBetween(Successor::kConditionEqual, head, tail);
+    AddSuccessorBetween(Successor::kConditionTrue, slow_path, tail);
+  }
+
+  inline_checks_.clear();
+  return true;
+}
+
+AsanBasicBlockTransform::SafeAccessKind
+AsanBasicBlockTransform::ClassifyAccess(
+    const Operand& operand,
+    const _DInst& repr,
+    StackAccessMode stack_mode) {
+  // A basic block reference means that can be either a computed jump, or a
+  // load from a case table. A block reference means this instruction is
+  // reading or writing to a global variable or some such. It's viable to pad
+  // and align global variables and to red-zone the padding, but without that,
+  // there's nothing to gain by instrumenting these accesses.
+  BasicBlockReference::ReferredType referred_type =
+      operand.displacement().reference().referred_type();
+  if (referred_type == BasicBlockReference::REFERRED_TYPE_BASIC_BLOCK ||
+      referred_type == BasicBlockReference::REFERRED_TYPE_BLOCK) {
+    return kImageAccess;
+  }
+
+  // If there are no unconventional manipulations of the stack frame, we can
+  // skip instrumenting stack-based memory access (based on ESP or EBP).
+  // Conventionally, accesses through ESP/EBP are always on stack.
+  if (stack_mode == kSafeStackAccess &&
+      (operand.base() == core::kRegisterEsp ||
+       operand.base() == core::kRegisterEbp)) {
+    return kStackAccess;
+  }
+
+  // Even when the stack frame is manipulated, ESP always points to the
+  // stack, and constant offsets from it stay within it.
+  if (operand.base() == core::kRegisterEsp &&
+      operand.index() == core::kRegisterNone) {
+    return kStackAccess;
+  }
+
+  // We do not instrument memory accesses through special segments.
+  // FS is used for thread local specifics and GS for CPU info.
+  uint8_t segment = SEGMENT_GET(repr.segment);
+  if (segment == R_FS || segment == R_GS)
+    return kSegmentAccess;
+
+  return kUnsafeAccess;
+}
+
 bool AsanBasicBlockTransform::TransformBasicBlockSubGraph(
     const TransformPolicyInterface* policy,
     BlockGraph* block_graph,
@@ -669,13 +1007,18 @@ bool AsanBasicBlockTransform::TransformBasicBlockSubGraph(
   DCHECK(block_graph != NULL);
   DCHECK(subgraph != NULL);
 
+  // Order the basic blocks once for both of the global analyses.
+  block_graph::analysis::ControlFlowAnalysis control_flow;
+  if (use_liveness_analysis_ || remove_redundant_checks_)
+    control_flow.Analyze(subgraph);
+
   // Perform a global liveness analysis.
   if (use_liveness_analysis_)
-    liveness_.Analyze(subgraph);
+    liveness_.Analyze(control_flow);
 
   // Perform a redundant memory access analysis.
   if (remove_redundant_checks_)
-    memory_accesses_.Analyze(subgraph);
+    memory_accesses_.Analyze(subgraph, control_flow);
 
   // Determines if this subgraph uses unconventional stack pointer
   // manipulations.
@@ -691,6 +1034,13 @@ bool AsanBasicBlockTransform::TransformBasicBlockSubGraph(
     if (bb != NULL && !InstrumentBasicBlock(bb, stack_mode))
       return false;
   }
+
+  if (!InstrumentHoistedChecks())
+    return false;
+
+  if (!InstrumentInlineChecks(subgraph))
+    return false;
+
   return true;
 }
 
@@ -700,13 +1050,38 @@ const char AsanTransform::kAsanHookStubName[] = "asan_hook_stub";
 
 const char AsanTransform::kSyzyAsanDll[] = "syzyasan_rtl.dll";
 
+const char AsanTransform::kAsanShadowMemoryName[] = "asan_shadow_memory";
+
+const char AsanTransform::kCheckCounterDll[] = "basic_block_entry_client.dll";
+
+const char AsanTransform::kCheckCounterHookName[] =
+    "_increment_indexed_freq_data";
+
 AsanTransform::AsanTransform()
     : asan_dll_name_(kSyzyAsanDll),
       debug_friendly_(false),
       use_liveness_analysis_(false),
       remove_redundant_checks_(false),
+      hoist_invariant_checks_(false),
+      inline_fast_path_(false),
+      inline_filter_(NULL),
+      hot_filter_(NULL),
+      instrumentation_rate_(1.0),
+      instrumentation_seed_(0),
       intercept_crt_functions_(false),
-      check_access_hooks_ref_() {
+      check_access_hooks_ref_(),
+      count_checks_(false),
+      add_check_counts_(common::kBasicBlockEntryAgentId,
+                        "Asan Check Frequency Data",
+                        common::kBasicBlockFrequencyDataVersion,
+                        common::IndexedFrequencyData::BASIC_BLOCK_ENTRY,
+                        sizeof(BasicBlockIndexedFrequencyData)) {
+}
+
+void AsanTransform::set_instrumentation_rate(double instrumentation_rate) {
+  DCHECK_LE(0.0, instrumentation_rate);
+  DCHECK_GE(1.0, instrumentation_rate);
+  instrumentation_rate_ = instrumentation_rate;
 }
 
 bool AsanTransform::PreBlockGraphIteration(
@@ -756,39 +1131,13 @@ bool AsanTransform::PreBlockGraphIteration(
 
   // Import the hooks for the read/write accesses.
   for (int access_size = 1; access_size <= 32; access_size *= 2) {
-    MemoryAccessInfo read_info =
-        { AsanBasicBlockTransform::kReadAccess, access_size, 0, true };
-    access_hook_param_vec.push_back(read_info);
-    if (use_liveness_analysis()) {
-      read_info.save_flags = false;
-      access_hook_param_vec.push_back(read_info);
-    }
-
-    MemoryAccessInfo write_info =
-        { AsanBasicBlockTransform::kWriteAccess, access_size, 0, true };
-    access_hook_param_vec.push_back(write_info);
-    if (use_liveness_analysis()) {
-      write_info.save_flags = false;
-      access_hook_param_vec.push_back(write_info);
-    }
+    AddReadWriteAccessHookParams(access_size, use_liveness_analysis(),
+                                 &access_hook_param_vec);
   }
 
   // Import the hooks for the read/write 10-bytes accesses.
-  MemoryAccessInfo read_info_10 =
-      { AsanBasicBlockTransform::kReadAccess, 10, 0, true };
-  access_hook_param_vec.push_back(read_info_10);
-  if (use_liveness_analysis()) {
-    read_info_10.save_flags = false;
-    access_hook_param_vec.push_back(read_info_10);
-  }
-
-  MemoryAccessInfo write_info_10 =
-      { AsanBasicBlockTransform::kWriteAccess, 10, 0, true };
-  access_hook_param_vec.push_back(write_info_10);
-  if (use_liveness_analysis()) {
-    write_info_10.save_flags = false;
-    access_hook_param_vec.push_back(write_info_10);
-  }
+  AddReadWriteAccessHookParams(10, use_liveness_analysis(),
+                               &access_hook_param_vec);
 
   // Import the hooks for strings/prefix memory accesses.
   const _InstructionType strings[] = { I_CMPS, I_MOVS, I_STOS };
@@ -800,7 +1149,8 @@ bool AsanTransform::PreBlockGraphIteration(
          AsanBasicBlockTransform::kRepzAccess,
          access_size,
          strings[inst],
-         true
+         true,
+         false
       };
       access_hook_param_vec.push_back(repz_inst_info);
 
@@ -808,12 +1158,24 @@ bool AsanTransform::PreBlockGraphIteration(
           AsanBasicBlockTransform::kInstrAccess,
           access_size,
           strings[inst],
-          true
+          true,
+          false
       };
       access_hook_param_vec.push_back(inst_info);
     }
   }
 
+  // Import the shadow memory, which is indexed directly by the inlined fast
+  // path of the checks. Unlike the hooks, its IAT entry can't be stubbed, so
+  // the inlined checks mustn't run before the imports are resolved. This
+  // rules out executables running under the Chrome sandbox.
+  bool import_shadow_memory = inline_fast_path_ || hot_filter_ != NULL;
+  size_t shadow_memory_index = 0;
+  if (import_shadow_memory) {
+    shadow_memory_index = import_module.AddSymbol(
+        kAsanShadowMemoryName, ImportedModule::kAlwaysImport);
+  }
+
   if (!AddAsanCheckAccessHooks(access_hook_param_vec,
                                default_stub_map,
                                &import_module,
@@ -823,6 +1185,41 @@ bool AsanTransform::PreBlockGraphIteration(
                                header_block)) {
     return false;
   }
+
+  if (import_shadow_memory &&
+      !import_module.GetSymbolReference(shadow_memory_index,
+                                        &shadow_memory_ref_)) {
+    LOG(ERROR) << "Unable to get import reference for the Asan shadow memory.";
+    return false;
+  }
+
+  // Import the hook counting the checks, and add the data it counts into.
+  if (count_checks_) {
+    ImportedModule counter_module(kCheckCounterDll);
+    size_t counter_hook_index = counter_module.AddSymbol(
+        kCheckCounterHookName, ImportedModule::kAlwaysImport);
+    PEAddImportsTransform add_counter_import;
+    add_counter_import.AddModule(&counter_module);
+    if (!ApplyBlockGraphTransform(
+            &add_counter_import, policy, block_graph, header_block)) {
+      LOG(ERROR) << "Unable to add the check counter hook import.";
+      return false;
+    }
+
+    if (!counter_module.GetSymbolReference(counter_hook_index,
+                                           &check_counter_hook_ref_)) {
+      LOG(ERROR) << "Unable to get import reference for the check counter "
+                 << "hook.";
+      return false;
+    }
+
+    if (!ApplyBlockGraphTransform(
+            &add_check_counts_, policy, block_graph, header_block)) {
+      LOG(ERROR) << "Failed to insert the check frequency data.";
+      return false;
+    }
+  }
+
   return true;
 }
 
@@ -832,27 +1229,81 @@ bool AsanTransform::OnBlock(const TransformPolicyInterface* policy,
   DCHECK(policy != NULL);
   DCHECK(block_graph != NULL);
   DCHECK(block != NULL);
-  if (block->type() != BlockGraph::CODE_BLOCK)
+  if (!ShouldDecomposeBlock(policy, block))
     return true;
 
-  if (!pe::CodeBlockIsBasicBlockDecomposable(block))
-    return true;
-
-  // Use the filter that was passed to us for our child transform.
   AsanBasicBlockTransform transform(&check_access_hooks_ref_);
-  transform.set_debug_friendly(debug_friendly());
-  transform.set_use_liveness_analysis(use_liveness_analysis());
-  transform.set_remove_redundant_checks(remove_redundant_checks());
-  transform.set_filter(filter());
+  ConfigureBasicBlockTransform(&transform);
 
   if (!ApplyBasicBlockSubGraphTransform(
           &transform, policy, block_graph, block, NULL)) {
     return false;
   }
+  stats_.Add(transform.stats());
+
+  return true;
+}
+
+bool AsanTransform::ShouldDecomposeBlock(
+    const TransformPolicyInterface* policy,
+    const BlockGraph::Block* block) {
+  DCHECK(policy != NULL);
+  DCHECK(block != NULL);
+
+  if (block->type() != BlockGraph::CODE_BLOCK)
+    return false;
+
+  return pe::CodeBlockIsBasicBlockDecomposable(block);
+}
+
+bool AsanTransform::OnDecomposedBlock(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockGraph::Block* block,
+    block_graph::BasicBlockSubGraph* subgraph) {
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+  DCHECK(block != NULL);
+  DCHECK(subgraph != NULL);
+  DCHECK_EQ(block, subgraph->original_block());
+
+  // The instrumentation only ever adds references to the hooks, which aren't
+  // decomposed, so the blocks can be decomposed concurrently.
+  AsanBasicBlockTransform transform(&check_access_hooks_ref_);
+  ConfigureBasicBlockTransform(&transform);
+
+  if (!ApplyBasicBlockSubGraphTransformToSubGraph(
+          &transform, policy, block_graph, subgraph, NULL)) {
+    return false;
+  }
+  stats_.Add(transform.stats());
 
   return true;
 }
 
+void AsanTransform::ConfigureBasicBlockTransform(
+    AsanBasicBlockTransform* transform) {
+  DCHECK(transform != NULL);
+
+  // Use the filter that was passed to us for our child transform.
+  transform->set_debug_friendly(debug_friendly());
+  transform->set_use_liveness_analysis(use_liveness_analysis());
+  transform->set_remove_redundant_checks(remove_redundant_checks());
+  transform->set_hoist_invariant_checks(hoist_invariant_checks());
+  transform->set_inline_fast_path(inline_fast_path());
+  transform->set_inline_filter(inline_filter());
+  transform->set_shadow_memory(shadow_memory_ref_);
+  transform->set_hot_filter(hot_filter());
+  transform->set_instrumentation_rate(instrumentation_rate());
+  transform->set_instrumentation_seed(instrumentation_seed());
+  transform->set_filter(filter());
+  if (count_checks_) {
+    transform->set_check_counter(check_counter_hook_ref_,
+                                 add_check_counts_.frequency_data_block(),
+                                 &check_sites_);
+  }
+}
+
 bool AsanTransform::PostBlockGraphIteration(
     const TransformPolicyInterface* policy,
     BlockGraph* block_graph,
@@ -861,6 +1312,18 @@ bool AsanTransform::PostBlockGraphIteration(
   DCHECK(block_graph != NULL);
   DCHECK(header_block != NULL);
 
+  // All the blocks have been instrumented at this point.
+  LOG(INFO) << "Emitted " << stats_.num_emitted << " memory access checks, "
+            << "elided " << stats_.num_elided() << " ("
+            << stats_.num_image_elided << " image, "
+            << stats_.num_stack_elided << " stack, "
+            << stats_.num_segment_elided << " segment accesses).";
+
+  if (count_checks_ &&
+      !AddCheckCounterEntryThunks(policy, block_graph, header_block)) {
+    return false;
+  }
+
   // This function redirects the heap-related kernel32 imports to point to a set
   // of "override" imports in the ASAN runtime.
 
@@ -996,6 +1459,56 @@ bool AsanTransform::PostBlockGraphIteration(
   return true;
 }
 
+bool AsanTransform::AddCheckCounterEntryThunks(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockGraph::Block* header_block) {
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+  DCHECK(header_block != NULL);
+  DCHECK(count_checks_);
+
+  if (check_sites_.empty()) {
+    LOG(WARNING) << "Encountered no memory access checks to count.";
+    return true;
+  }
+
+  if (!add_check_counts_.ConfigureFrequencyDataBuffer(check_sites_.size(), 1,
+                                                      sizeof(uint32))) {
+    LOG(ERROR) << "Failed to configure the check frequency data buffer.";
+    return false;
+  }
+
+  // Initialize the basic-block entry agent specific fields.
+  TypedBlock<BasicBlockIndexedFrequencyData> frequency_data;
+  CHECK(frequency_data.Init(0, add_check_counts_.frequency_data_block()));
+  frequency_data->fs_slot = 0;
+  frequency_data->tls_index = TLS_OUT_OF_INDEXES;
+
+  // The agent registers the module, and allocates its counters, when the
+  // module entry points are called.
+  EntryThunkTransform add_thunks;
+  add_thunks.set_only_instrument_module_entry(true);
+  add_thunks.set_instrument_dll_name(kCheckCounterDll);
+  add_thunks.set_src_ranges_for_thunks(debug_friendly_);
+  Immediate module_data(add_check_counts_.frequency_data_block(), 0);
+  if (!add_thunks.SetEntryThunkParameter(module_data)) {
+    LOG(ERROR) << "Failed to configure the check counter entry thunks.";
+    return false;
+  }
+
+  if (!ApplyBlockGraphTransform(
+          &add_thunks, policy, block_graph, header_block)) {
+    LOG(ERROR) << "Unable to thunk module entry points.";
+    return false;
+  }
+
+  LOG(INFO) << "Counting the checks of " << check_sites_.size()
+            << " memory accesses.";
+
+  return true;
+}
+
 bool AsanTransform::InterceptFunctions(
     ImportedModule* import_module,
     const TransformPolicyInterface* policy,
@@ -1125,6 +1638,8 @@ bool operator<(const AsanBasicBlockTransform::MemoryAccessInfo& left,
     return left.size < right.size;
   if (left.save_flags != right.save_flags)
     return left.save_flags < right.save_flags;
+  if (left.clobber_edx != right.clobber_edx)
+    return left.clobber_edx < right.clobber_edx;
   return left.opcode < right.opcode;
 }
 
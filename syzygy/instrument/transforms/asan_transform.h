@@ -21,6 +21,7 @@
 #include <set>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "base/string_piece.h"
 #include "syzygy/block_graph/filterable.h"
@@ -29,6 +30,8 @@
 #include "syzygy/block_graph/analysis/memory_access_analysis.h"
 #include "syzygy/block_graph/transforms/iterative_transform.h"
 #include "syzygy/block_graph/transforms/named_transform.h"
+#include "syzygy/core/address_space.h"
+#include "syzygy/instrument/transforms/add_indexed_frequency_data_transform.h"
 #include "syzygy/pe/transforms/pe_add_imports_transform.h"
 
 namespace instrument {
@@ -55,6 +58,51 @@ class AsanBasicBlockTransform
     kSafeStackAccess,
   };
 
+  // The classes of memory accesses that provably can't touch the heap, and
+  // so are never checked.
+  enum SafeAccessKind {
+    // The access may touch the heap, and is checked.
+    kUnsafeAccess,
+    // An access to the image itself, through a reference to one of its
+    // blocks: a global variable, a jump table, a case table...
+    kImageAccess,
+    // An access to the stack, either at a constant offset from ESP or
+    // through EBP in a block with a conventional stack frame. The stack
+    // isn't red-zoned.
+    kStackAccess,
+    // An access through the FS or GS segment, which hold thread-specific
+    // data and CPU information.
+    kSegmentAccess,
+  };
+
+  // Counts the checks of the memory accesses, by outcome.
+  struct AccessCheckStats {
+    AccessCheckStats()
+        : num_emitted(0), num_image_elided(0), num_stack_elided(0),
+          num_segment_elided(0) {
+    }
+
+    // Adds @p other to these counts.
+    void Add(const AccessCheckStats& other) {
+      num_emitted += other.num_emitted;
+      num_image_elided += other.num_image_elided;
+      num_stack_elided += other.num_stack_elided;
+      num_segment_elided += other.num_segment_elided;
+    }
+
+    // @returns the total number of elided checks.
+    size_t num_elided() const {
+      return num_image_elided + num_stack_elided + num_segment_elided;
+    }
+
+    // The number of checks emitted, hoisted and inlined ones included.
+    size_t num_emitted;
+    // The number of checks elided for each class of safe accesses.
+    size_t num_image_elided;
+    size_t num_stack_elided;
+    size_t num_segment_elided;
+  };
+
   // Contains memory access information.
   struct MemoryAccessInfo {
     MemoryAccessMode mode;
@@ -62,6 +110,9 @@ class AsanBasicBlockTransform
     uint16_t opcode;
     // True iff we need to save the flags for this access.
     bool save_flags;
+    // True iff EDX is dead at this access, in which case the check doesn't
+    // need to preserve it.
+    bool clobber_edx;
   };
 
   typedef block_graph::BlockGraph BlockGraph;
@@ -71,6 +122,9 @@ class AsanBasicBlockTransform
   // Map of hooks to asan check access functions.
   typedef std::map<AsanHookMapEntryKey, BlockGraph::Reference> AsanHookMap;
   typedef std::map<MemoryAccessMode, BlockGraph::Reference> AsanDefaultHookMap;
+  typedef core::AddressRange<core::RelativeAddress, size_t>
+      RelativeAddressRange;
+  typedef std::vector<RelativeAddressRange> RelativeAddressRangeVector;
 
   // Constructor.
   // @param hooks_read_access a reference to the read access check import entry.
@@ -80,7 +134,15 @@ class AsanBasicBlockTransform
       check_access_hooks_(check_access_hooks),
       debug_friendly_(false),
       use_liveness_analysis_(false),
-      remove_redundant_checks_(false) {
+      remove_redundant_checks_(false),
+      hoist_invariant_checks_(false),
+      inline_fast_path_(false),
+      inline_filter_(NULL),
+      hot_filter_(NULL),
+      instrumentation_rate_(1.0),
+      instrumentation_seed_(0),
+      check_counter_data_(NULL),
+      check_sites_(NULL) {
     DCHECK(check_access_hooks != NULL);
   }
 
@@ -99,11 +161,78 @@ class AsanBasicBlockTransform
     remove_redundant_checks_ = remove_redundant_checks;
   }
 
+  bool hoist_invariant_checks() const { return hoist_invariant_checks_; }
+  void set_hoist_invariant_checks(bool hoist_invariant_checks) {
+    hoist_invariant_checks_ = hoist_invariant_checks;
+  }
+
+  bool inline_fast_path() const { return inline_fast_path_; }
+  void set_inline_fast_path(bool inline_fast_path) {
+    inline_fast_path_ = inline_fast_path;
+  }
+
+  const block_graph::RelativeAddressFilter* inline_filter() const {
+    return inline_filter_;
+  }
+  void set_inline_filter(const block_graph::RelativeAddressFilter* filter) {
+    inline_filter_ = filter;
+  }
+
+  const BlockGraph::Reference& shadow_memory() const { return shadow_memory_; }
+  void set_shadow_memory(const BlockGraph::Reference& shadow_memory) {
+    shadow_memory_ = shadow_memory;
+  }
+
+  const block_graph::RelativeAddressFilter* hot_filter() const {
+    return hot_filter_;
+  }
+  void set_hot_filter(const block_graph::RelativeAddressFilter* filter) {
+    hot_filter_ = filter;
+  }
+
+  double instrumentation_rate() const { return instrumentation_rate_; }
+  void set_instrumentation_rate(double instrumentation_rate);
+
+  uint32 instrumentation_seed() const { return instrumentation_seed_; }
+  void set_instrumentation_seed(uint32 instrumentation_seed) {
+    instrumentation_seed_ = instrumentation_seed;
+  }
+
+  const AccessCheckStats& stats() const { return stats_; }
   // @}
 
+  // Enables the counting of the checks. Each checked access is given the
+  // index of the entry appended to @p check_sites for it, and its checks are
+  // preceded by a call to @p hook counting them in @p data.
+  // @param hook The reference to the counter hook import entry. This takes
+  //     the index and @p data on the stack, and preserves the registers and
+  //     the flags.
+  // @param data The indexed frequency data the checks are counted into.
+  // @param check_sites Receives the range of each checked instruction in the
+  //     original image.
+  void set_check_counter(const BlockGraph::Reference& hook,
+                         BlockGraph::Block* data,
+                         RelativeAddressRangeVector* check_sites) {
+    DCHECK(data != NULL);
+    DCHECK(check_sites != NULL);
+    check_counter_hook_ = hook;
+    check_counter_data_ = data;
+    check_sites_ = check_sites;
+  }
+
   // The transform name.
   static const char kTransformName[];
 
+  // Classifies a memory access by whether it's provably safe.
+  // @param operand The memory operand of the access.
+  // @param repr The representation of the instruction performing the access.
+  // @param stack_mode The stack access mode of the block of the access.
+  // @returns the class of the access if it's provably safe, kUnsafeAccess
+  //     otherwise.
+  static SafeAccessKind ClassifyAccess(const block_graph::Operand& operand,
+                                       const _DInst& repr,
+                                       StackAccessMode stack_mode);
+
  protected:
   // @name BasicBlockSubGraphTransformInterface method.
   virtual bool TransformBasicBlockSubGraph(
@@ -122,6 +251,88 @@ class AsanBasicBlockTransform
   bool InstrumentBasicBlock(block_graph::BasicCodeBlock* basic_block,
                             StackAccessMode stack_mode);
 
+  // Instruments the memory accesses whose checks were hoisted out of their
+  // basic block by InstrumentBasicBlock. The checks are appended to the
+  // predecessors of the basic blocks performing the accesses.
+  // @returns true on success, false otherwise.
+  bool InstrumentHoistedChecks();
+
+  // Registers a checked access when the checks are counted.
+  // @param source_range The source range of the instruction performing the
+  //     access.
+  // @returns the index of the counter of the access.
+  size_t AddCheckSite(
+      const block_graph::Instruction::SourceRange& source_range);
+
+  // Injects a call to the counter hook, when the checks are counted.
+  // @param bb_asm The assembler used to inject the call.
+  // @param counter_index The index of the counter to increment.
+  void InjectCheckCounter(block_graph::BasicBlockAssembler* bb_asm,
+                          size_t counter_index);
+
+  // A memory access check hoisted to the end of a basic block.
+  struct HoistedCheck {
+    HoistedCheck(block_graph::BasicCodeBlock* bb,
+                 const MemoryAccessInfo& access_info,
+                 const block_graph::Operand& access_operand,
+                 const block_graph::Instruction::SourceRange& range,
+                 size_t counter)
+        : basic_block(bb), info(access_info), operand(access_operand),
+          source_range(range), counter_index(counter) {
+    }
+
+    // The basic block the check is appended to.
+    block_graph::BasicCodeBlock* basic_block;
+    // The access to check.
+    MemoryAccessInfo info;
+    block_graph::Operand operand;
+    // The source range of the instruction performing the access.
+    block_graph::Instruction::SourceRange source_range;
+    // The index of the counter of the access, shared by all of its hoisted
+    // checks.
+    size_t counter_index;
+  };
+  typedef std::vector<HoistedCheck> HoistedChecks;
+
+  // The checks hoisted by InstrumentBasicBlock, pending instrumentation.
+  HoistedChecks hoisted_checks_;
+
+  // Instruments the memory accesses whose checks were selected by
+  // InstrumentBasicBlock to have their fast path inlined. The basic block of
+  // each such access is split right before it, the inlined fast path ending
+  // the first half and branching to an out-of-line call to the regular hook
+  // when the shadow byte of the access isn't zero.
+  // @param subgraph The subgraph the basic blocks belong to.
+  // @returns true on success, false otherwise.
+  bool InstrumentInlineChecks(BasicBlockSubGraph* subgraph);
+
+  // A memory access whose check has its fast path inlined.
+  struct InlineCheck {
+    InlineCheck(block_graph::BasicCodeBlock* bb,
+                block_graph::BasicBlock::Instructions::iterator instr,
+                const MemoryAccessInfo& access_info,
+                const block_graph::Operand& access_operand,
+                size_t counter)
+        : basic_block(bb), instruction(instr), info(access_info),
+          operand(access_operand), counter_index(counter) {
+    }
+
+    // The basic block performing the access.
+    block_graph::BasicCodeBlock* basic_block;
+    // The instruction performing the access.
+    block_graph::BasicBlock::Instructions::iterator instruction;
+    // The access to check.
+    MemoryAccessInfo info;
+    block_graph::Operand operand;
+    // The index of the counter of the access.
+    size_t counter_index;
+  };
+  typedef std::vector<InlineCheck> InlineChecks;
+
+  // The checks selected by InstrumentBasicBlock to be inlined, in the order
+  // of the accesses within each basic block, pending instrumentation.
+  InlineChecks inline_checks_;
+
  private:
   // Liveness analysis and liveness information for this subgraph.
   block_graph::analysis::LivenessAnalysis liveness_;
@@ -142,6 +353,46 @@ class AsanBasicBlockTransform
   // memory checks added by this transform.
   bool remove_redundant_checks_;
 
+  // When activated along with the redundancy elimination, the checks of the
+  // accesses that are only redundant along some paths (e.g. loop-invariant
+  // accesses) are hoisted to the predecessors along which they're not.
+  bool hoist_invariant_checks_;
+
+  // When activated along with the liveness analysis, the shadow byte of the
+  // read and write accesses performed while the flags are dead is tested
+  // inline, and the hooks are only called when it isn't zero.
+  bool inline_fast_path_;
+
+  // When set, the fast path is only inlined into the code marked in this
+  // filter. It's inlined everywhere otherwise.
+  const block_graph::RelativeAddressFilter* inline_filter_;
+
+  // The reference to the shadow memory import entry. Must be valid when the
+  // fast path is inlined.
+  BlockGraph::Reference shadow_memory_;
+
+  // The filter marking the hottest basic blocks, if any. In these, the fast
+  // path of the checks is inlined where possible. This requires
+  // shadow_memory_ to be valid.
+  const block_graph::RelativeAddressFilter* hot_filter_;
+
+  // The fraction of the memory accesses that get instrumented, in [0, 1].
+  // The accesses are selected by hashing their address in the original image
+  // with instrumentation_seed_, so that a given seed always instruments the
+  // same accesses.
+  double instrumentation_rate_;
+  uint32 instrumentation_seed_;
+
+  // The counts of the checks emitted and elided so far.
+  AccessCheckStats stats_;
+
+  // When counting the checks, the reference to the counter hook import
+  // entry, the data the checks are counted into and the ranges of the
+  // checked instructions, by counter index. check_sites_ is NULL otherwise.
+  BlockGraph::Reference check_counter_hook_;
+  BlockGraph::Block* check_counter_data_;
+  RelativeAddressRangeVector* check_sites_;
+
   DISALLOW_COPY_AND_ASSIGN(AsanBasicBlockTransform);
 };
 
@@ -153,6 +404,8 @@ class AsanTransform
   typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
   typedef AsanBasicBlockTransform::MemoryAccessInfo MemoryAccessInfo;
   typedef AsanBasicBlockTransform::MemoryAccessMode MemoryAccessMode;
+  typedef AsanBasicBlockTransform::RelativeAddressRangeVector
+      RelativeAddressRangeVector;
 
   // Initialize a new AsanTransform instance.
   AsanTransform();
@@ -168,6 +421,12 @@ class AsanTransform
   bool PostBlockGraphIteration(const TransformPolicyInterface* policy,
                                BlockGraph* block_graph,
                                BlockGraph::Block* header_block);
+  bool ShouldDecomposeBlock(const TransformPolicyInterface* policy,
+                            const BlockGraph::Block* block);
+  bool OnDecomposedBlock(const TransformPolicyInterface* policy,
+                         BlockGraph* block_graph,
+                         BlockGraph::Block* block,
+                         block_graph::BasicBlockSubGraph* subgraph);
   // @}
 
   // @name Accessors.
@@ -197,6 +456,51 @@ class AsanTransform
     remove_redundant_checks_ = remove_redundant_checks;
   }
 
+  bool hoist_invariant_checks() const { return hoist_invariant_checks_; }
+  void set_hoist_invariant_checks(bool hoist_invariant_checks) {
+    hoist_invariant_checks_ = hoist_invariant_checks;
+  }
+
+  bool inline_fast_path() const { return inline_fast_path_; }
+  void set_inline_fast_path(bool inline_fast_path) {
+    inline_fast_path_ = inline_fast_path;
+  }
+
+  const block_graph::RelativeAddressFilter* inline_filter() const {
+    return inline_filter_;
+  }
+  void set_inline_filter(const block_graph::RelativeAddressFilter* filter) {
+    inline_filter_ = filter;
+  }
+
+  const block_graph::RelativeAddressFilter* hot_filter() const {
+    return hot_filter_;
+  }
+  void set_hot_filter(const block_graph::RelativeAddressFilter* filter) {
+    hot_filter_ = filter;
+  }
+
+  double instrumentation_rate() const { return instrumentation_rate_; }
+  void set_instrumentation_rate(double instrumentation_rate);
+
+  uint32 instrumentation_seed() const { return instrumentation_seed_; }
+  void set_instrumentation_seed(uint32 instrumentation_seed) {
+    instrumentation_seed_ = instrumentation_seed;
+  }
+
+  const AsanBasicBlockTransform::AccessCheckStats& stats() const {
+    return stats_;
+  }
+
+  bool count_checks() const { return count_checks_; }
+  void set_count_checks(bool count_checks) { count_checks_ = count_checks; }
+
+  // @returns the RVAs and sizes in the original image of the instructions
+  //     whose checks are counted. The index of an instruction in the vector
+  //     is the index of its counter.
+  const RelativeAddressRangeVector& check_sites() const {
+    return check_sites_;
+  }
   // @}
 
   // The name of the DLL that is imported by default.
@@ -208,6 +512,14 @@ class AsanTransform
   // The hooks stub name.
   static const char kAsanHookStubName[];
 
+  // The name of the shadow memory export of the runtime. This is a pointer to
+  // the shadow memory.
+  static const char kAsanShadowMemoryName[];
+
+  // The agent counting the checks, and the name of its counter hook.
+  static const char kCheckCounterDll[];
+  static const char kCheckCounterHookName[];
+
  protected:
   // A structure containing the information that we need to intercept a
   // function.
@@ -222,6 +534,21 @@ class AsanTransform
   };
 
   typedef pe::transforms::ImportedModule ImportedModule;
+
+  // Sizes the frequency data the checks are counted into, and thunks the
+  // module entry points so that the agent counting them is notified of the
+  // module.
+  // @param policy The policy object restricting how the transform is applied.
+  // @param block_graph The block-graph to modify.
+  // @param header_block The block containing the module's DOS header.
+  // @returns true on success, false on error.
+  bool AddCheckCounterEntryThunks(const TransformPolicyInterface* policy,
+                                  BlockGraph* block_graph,
+                                  BlockGraph::Block* header_block);
+
+  // Configures the basic-block transform applied to each block.
+  // @param transform the transform to configure.
+  void ConfigureBasicBlockTransform(AsanBasicBlockTransform* transform);
   typedef std::set<std::string> FunctionInterceptionSet;
   typedef std::map<std::string,
                    FunctionInterceptionInfo> FunctionInterceptionInfoMap;
@@ -256,6 +583,26 @@ class AsanTransform
   // memory checks added by this transform.
   bool remove_redundant_checks_;
 
+  // When activated along with the redundancy elimination, loop-invariant
+  // checks are hoisted out of their loops.
+  bool hoist_invariant_checks_;
+
+  // When activated along with the liveness analysis, the fast path of the
+  // access checks is inlined.
+  bool inline_fast_path_;
+
+  // The filter marking the code the fast path is inlined into, if any.
+  const block_graph::RelativeAddressFilter* inline_filter_;
+
+  // The filter marking the hottest basic blocks, if any. These are
+  // instrumented with the cheapest checks.
+  const block_graph::RelativeAddressFilter* hot_filter_;
+
+  // The fraction of the memory accesses that get instrumented, and the seed
+  // selecting them.
+  double instrumentation_rate_;
+  uint32 instrumentation_seed_;
+
   // Set iff we should intercept the CRT functions.
   bool intercept_crt_functions_;
 
@@ -263,6 +610,26 @@ class AsanTransform
   // successful PreBlockGraphIteration.
   AsanBasicBlockTransform::AsanHookMap check_access_hooks_ref_;
 
+  // The reference to the shadow memory import entry. Valid after successful
+  // PreBlockGraphIteration when the fast path is inlined.
+  BlockGraph::Reference shadow_memory_ref_;
+
+  // The counts of the checks emitted and elided in the whole image.
+  AsanBasicBlockTransform::AccessCheckStats stats_;
+
+  // Set iff each check should count its executions. The counts are kept by
+  // the basic-block entry agent, in the frequency data added by
+  // add_check_counts_, so that grinder can process them.
+  bool count_checks_;
+  AddIndexedFrequencyDataTransform add_check_counts_;
+
+  // The reference to the counter hook import entry. Valid after successful
+  // PreBlockGraphIteration when the checks are counted.
+  BlockGraph::Reference check_counter_hook_ref_;
+
+  // The ranges of the instructions whose checks are counted.
+  RelativeAddressRangeVector check_sites_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(AsanTransform);
 };
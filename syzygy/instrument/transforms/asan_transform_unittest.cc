@@ -16,6 +16,7 @@
 
 #include "syzygy/instrument/transforms/asan_transform.h"
 
+#include <iterator>
 #include <set>
 #include <vector>
 
@@ -43,11 +44,13 @@ namespace transforms {
 namespace {
 
 using block_graph::BasicBlock;
+using block_graph::BasicBlockReference;
 using block_graph::BasicCodeBlock;
 using block_graph::BasicBlockSubGraph;
 using block_graph::BlockGraph;
 using block_graph::Instruction;
 using block_graph::RelativeAddressFilter;
+using block_graph::Successor;
 using core::RelativeAddress;
 typedef AsanBasicBlockTransform::MemoryAccessMode AsanMemoryAccessMode;
 typedef AsanBasicBlockTransform::AsanHookMap HookMap;
@@ -57,6 +60,7 @@ typedef AsanBasicBlockTransform::AsanHookMapEntryKey HookMapEntryKey;
 class TestAsanBasicBlockTransform : public AsanBasicBlockTransform {
  public:
   using AsanBasicBlockTransform::InstrumentBasicBlock;
+  using AsanBasicBlockTransform::TransformBasicBlockSubGraph;
 
   explicit TestAsanBasicBlockTransform(AsanHookMap* hooks_check_access)
       : AsanBasicBlockTransform(hooks_check_access) {
@@ -83,12 +87,14 @@ class AsanTransformTest : public testing::TestDllTransformTest {
                   AsanBasicBlockTransform::MemoryAccessMode access_kind,
                   int access_size,
                   uint16_t opcode,
-                  bool save_flags) {
+                  bool save_flags,
+                  bool clobber_edx) {
       HookMapEntryKey map_key = {
           access_kind,
           access_size,
           opcode,
-          save_flags
+          save_flags,
+          clobber_edx
       };
       hooks_check_access_[map_key] =
           block_graph_.AddBlock(BlockGraph::CODE_BLOCK, 4, hook_name);
@@ -104,20 +110,28 @@ class AsanTransformTest : public testing::TestDllTransformTest {
       std::string name =
           base::StringPrintf("asan_check_%d_byte_read_access", access_size);
       AddHookRef(name, AsanBasicBlockTransform::kReadAccess, access_size, 0,
+                 true, false);
+      AddHookRef(name + "_no_flags", AsanBasicBlockTransform::kReadAccess,
+                 access_size, 0, false, false);
+      AddHookRef(name + "_no_edx", AsanBasicBlockTransform::kReadAccess,
+                 access_size, 0, true, true);
+      AddHookRef(name + "_no_edx_no_flags",
+                 AsanBasicBlockTransform::kReadAccess, access_size, 0, false,
                  true);
-      name += "_no_flags";
-      AddHookRef(name, AsanBasicBlockTransform::kReadAccess, access_size, 0,
-                 false);
     }
     // Initialize the write access hooks.
     for (int access_size = 1; access_size <= 8; access_size *= 2) {
       std::string name =
           base::StringPrintf("asan_check_%d_byte_write_access", access_size);
       AddHookRef(name, AsanBasicBlockTransform::kWriteAccess, access_size, 0,
+                 true, false);
+      AddHookRef(name + "_no_flags", AsanBasicBlockTransform::kWriteAccess,
+                 access_size, 0, false, false);
+      AddHookRef(name + "_no_edx", AsanBasicBlockTransform::kWriteAccess,
+                 access_size, 0, true, true);
+      AddHookRef(name + "_no_edx_no_flags",
+                 AsanBasicBlockTransform::kWriteAccess, access_size, 0, false,
                  true);
-      name += "_no_flags";
-      AddHookRef(name, AsanBasicBlockTransform::kWriteAccess, access_size, 0,
-                 false);
     }
 
     const _InstructionType strings[] = { I_CMPS, I_MOVS, I_STOS };
@@ -133,7 +147,7 @@ class AsanTransformTest : public testing::TestDllTransformTest {
                                access_size, opcode_str);
         StringToLowerASCII(&name);
         AddHookRef(name, AsanBasicBlockTransform::kRepzAccess, access_size,
-                   opcode, true);
+                   opcode, true, false);
       }
     }
 
@@ -150,7 +164,7 @@ class AsanTransformTest : public testing::TestDllTransformTest {
                                access_size, opcode_str);
         StringToLowerASCII(&name);
         AddHookRef(name, AsanBasicBlockTransform::kInstrAccess, access_size,
-                   opcode, true);
+                   opcode, true, false);
 
         // Initialize the strings with prefix access hooks.
          std::string repz_name =
@@ -158,11 +172,94 @@ class AsanTransformTest : public testing::TestDllTransformTest {
                                access_size, opcode_str);
         StringToLowerASCII(&repz_name);
         AddHookRef(repz_name, AsanBasicBlockTransform::kRepzAccess, access_size,
-                   opcode, true);
+                   opcode, true, false);
       }
     }
   }
 
+  // Builds a loop in @p subgraph, entered from @p bb_entry, and which reads
+  // [esi + 8] and writes to [edi] on every iteration of @p bb_loop.
+  void BuildLoop(BasicBlockSubGraph* subgraph,
+                 BasicCodeBlock** bb_entry,
+                 BasicCodeBlock** bb_loop) {
+    ASSERT_TRUE(subgraph != NULL);
+    ASSERT_TRUE(bb_entry != NULL);
+    ASSERT_TRUE(bb_loop != NULL);
+
+    BasicBlockSubGraph::BlockDescription* block =
+        subgraph->AddBlockDescription("b1", "b1.obj", BlockGraph::CODE_BLOCK,
+                                      7, 2, 42);
+    *bb_entry = subgraph->AddBasicCodeBlock("entry");
+    *bb_loop = subgraph->AddBasicCodeBlock("loop");
+    BasicCodeBlock* bb_exit = subgraph->AddBasicCodeBlock("exit");
+    block->basic_block_order.push_back(*bb_entry);
+    block->basic_block_order.push_back(*bb_loop);
+    block->basic_block_order.push_back(bb_exit);
+
+    AddSuccessor(Successor::kConditionTrue, *bb_entry, *bb_loop);
+    AddSuccessor(Successor::kConditionNotEqual, *bb_loop, *bb_loop);
+    AddSuccessor(Successor::kConditionEqual, *bb_loop, bb_exit);
+
+    block_graph::BasicBlockAssembler entry_asm(
+        (*bb_entry)->instructions().end(), &(*bb_entry)->instructions());
+    entry_asm.mov(core::ecx, block_graph::Operand(core::ebx));
+
+    block_graph::BasicBlockAssembler loop_asm(
+        (*bb_loop)->instructions().end(), &(*bb_loop)->instructions());
+    loop_asm.mov(core::eax, block_graph::Operand(
+        core::esi, block_graph::Displacement(8, core::kSize8Bit)));
+    loop_asm.mov(block_graph::Operand(core::edi), core::eax);
+
+    block_graph::BasicBlockAssembler exit_asm(
+        bb_exit->instructions().end(), &bb_exit->instructions());
+    exit_asm.ret();
+  }
+
+  // Adds @p count read accesses to basic_block_, each with its own source
+  // range, and the same number of unrelated instructions.
+  void AddSourcedAccesses(size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      bb_asm_->mov(core::eax, block_graph::Operand(core::ebx));
+      bb_asm_->mov(core::ecx, core::eax);
+    }
+
+    BasicBlock::Instructions::iterator iter_inst =
+        basic_block_->instructions().begin();
+    for (size_t i = 0; iter_inst != basic_block_->instructions().end();
+         ++iter_inst, ++i) {
+      iter_inst->set_source_range(Instruction::SourceRange(
+          RelativeAddress(0x1000 + 2 * i), 2));
+    }
+  }
+
+  // Gets the addresses of the instrumented accesses in basic_block_, which
+  // are those right after a call to a hook.
+  void GetInstrumentedAccesses(std::set<RelativeAddress>* accesses) const {
+    ASSERT_TRUE(accesses != NULL);
+    accesses->clear();
+
+    BasicBlock::Instructions::const_iterator iter_inst =
+        basic_block_->instructions().begin();
+    for (; iter_inst != basic_block_->instructions().end(); ++iter_inst) {
+      if (iter_inst->representation().opcode != I_CALL)
+        continue;
+      BasicBlock::Instructions::const_iterator access = iter_inst;
+      ASSERT_TRUE(++access != basic_block_->instructions().end());
+      accesses->insert(access->source_range().start());
+    }
+  }
+
+  void AddSuccessor(Successor::Condition condition,
+                    BasicCodeBlock* from,
+                    BasicCodeBlock* to) {
+    from->successors().push_back(
+        Successor(condition,
+                  BasicBlockReference(BlockGraph::RELATIVE_REF,
+                                      BlockGraph::Reference::kMaximumSize,
+                                      to),
+                  0));
+  }
+
   bool AddInstructionFromBuffer(const uint8* data, size_t length) {
     DCHECK(data != NULL);
     DCHECK(length < core::AssemblerImpl::kMaxInstructionLength);
@@ -241,6 +338,62 @@ TEST_F(AsanTransformTest, SetRemoveRedundantChecksFlag) {
   EXPECT_FALSE(bb_transform.remove_redundant_checks());
 }
 
+TEST_F(AsanTransformTest, SetHoistInvariantChecksFlag) {
+  EXPECT_FALSE(asan_transform_.hoist_invariant_checks());
+  asan_transform_.set_hoist_invariant_checks(true);
+  EXPECT_TRUE(asan_transform_.hoist_invariant_checks());
+  asan_transform_.set_hoist_invariant_checks(false);
+  EXPECT_FALSE(asan_transform_.hoist_invariant_checks());
+
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  EXPECT_FALSE(bb_transform.hoist_invariant_checks());
+  bb_transform.set_hoist_invariant_checks(true);
+  EXPECT_TRUE(bb_transform.hoist_invariant_checks());
+  bb_transform.set_hoist_invariant_checks(false);
+  EXPECT_FALSE(bb_transform.hoist_invariant_checks());
+}
+
+TEST_F(AsanTransformTest, SetInlineFastPathFlag) {
+  EXPECT_FALSE(asan_transform_.inline_fast_path());
+  asan_transform_.set_inline_fast_path(true);
+  EXPECT_TRUE(asan_transform_.inline_fast_path());
+  asan_transform_.set_inline_fast_path(false);
+  EXPECT_FALSE(asan_transform_.inline_fast_path());
+
+  RelativeAddressFilter filter;
+  EXPECT_TRUE(asan_transform_.inline_filter() == NULL);
+  asan_transform_.set_inline_filter(&filter);
+  EXPECT_EQ(&filter, asan_transform_.inline_filter());
+
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  EXPECT_FALSE(bb_transform.inline_fast_path());
+  bb_transform.set_inline_fast_path(true);
+  EXPECT_TRUE(bb_transform.inline_fast_path());
+  bb_transform.set_inline_fast_path(false);
+  EXPECT_FALSE(bb_transform.inline_fast_path());
+
+  EXPECT_TRUE(bb_transform.inline_filter() == NULL);
+  bb_transform.set_inline_filter(&filter);
+  EXPECT_EQ(&filter, bb_transform.inline_filter());
+}
+
+TEST_F(AsanTransformTest, SetInstrumentationRate) {
+  EXPECT_EQ(1.0, asan_transform_.instrumentation_rate());
+  asan_transform_.set_instrumentation_rate(0.25);
+  EXPECT_EQ(0.25, asan_transform_.instrumentation_rate());
+  EXPECT_EQ(0u, asan_transform_.instrumentation_seed());
+  asan_transform_.set_instrumentation_seed(42);
+  EXPECT_EQ(42u, asan_transform_.instrumentation_seed());
+
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  EXPECT_EQ(1.0, bb_transform.instrumentation_rate());
+  bb_transform.set_instrumentation_rate(0.25);
+  EXPECT_EQ(0.25, bb_transform.instrumentation_rate());
+  EXPECT_EQ(0u, bb_transform.instrumentation_seed());
+  bb_transform.set_instrumentation_seed(42);
+  EXPECT_EQ(42u, bb_transform.instrumentation_seed());
+}
+
 TEST_F(AsanTransformTest, ApplyAsanTransform) {
   ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
 
@@ -253,6 +406,24 @@ TEST_F(AsanTransformTest, ApplyAsanTransform) {
   // the labels in the new block-graph.
 }
 
+TEST_F(AsanTransformTest, CountChecksInTestDll) {
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
+
+  EXPECT_FALSE(asan_transform_.count_checks());
+  asan_transform_.set_count_checks(true);
+  ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+      &asan_transform_, &policy_, &block_graph_, dos_header_block_));
+
+  // The checked accesses are recorded, and the agent counting their checks
+  // is imported.
+  EXPECT_FALSE(asan_transform_.check_sites().empty());
+  bool has_counter_import = false;
+  ASSERT_TRUE(pe::HasImportEntry(dos_header_block_,
+                                 AsanTransform::kCheckCounterDll,
+                                 &has_counter_import));
+  EXPECT_TRUE(has_counter_import);
+}
+
 TEST_F(AsanTransformTest, InjectAsanHooks) {
   // Add a read access to the memory.
   bb_asm_->mov(core::eax, block_graph::Operand(core::ebx));
@@ -316,6 +487,100 @@ TEST_F(AsanTransformTest, InjectAsanHooks) {
   ASSERT_TRUE(iter_inst == basic_block_->instructions().end());
 }
 
+TEST_F(AsanTransformTest, InjectCheckCounters) {
+  // Add a read access and a write access to the memory.
+  bb_asm_->mov(core::eax, block_graph::Operand(core::ebx));
+  bb_asm_->mov(block_graph::Operand(core::ecx), core::edx);
+
+  // Add source ranges to the instructions.
+  BasicBlock::Instructions::iterator iter_inst =
+      basic_block_->instructions().begin();
+  Instruction::SourceRange range1(RelativeAddress(1000), iter_inst->size());
+  (iter_inst++)->set_source_range(range1);
+  Instruction::SourceRange range2(RelativeAddress(1002), iter_inst->size());
+  iter_inst->set_source_range(range2);
+
+  // Instrument this basic block, counting the checks.
+  InitHooksRefs();
+  BlockGraph::Block* counter_hook =
+      block_graph_.AddBlock(BlockGraph::DATA_BLOCK, 4, "counter_hook");
+  BlockGraph::Block* counter_data =
+      block_graph_.AddBlock(BlockGraph::DATA_BLOCK, 4, "counter_data");
+  AsanBasicBlockTransform::RelativeAddressRangeVector check_sites;
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.set_check_counter(
+      BlockGraph::Reference(BlockGraph::ABSOLUTE_REF, 4, counter_hook, 0, 0),
+      counter_data, &check_sites);
+  ASSERT_TRUE(bb_transform.InstrumentBasicBlock(
+      basic_block_, AsanBasicBlockTransform::kSafeStackAccess));
+
+  // Each check is preceded by a call to the counter hook, passing the index
+  // of the access and the counter data.
+  ASSERT_EQ(2u + 2 * (3 + 3), basic_block_->instructions().size());
+  iter_inst = basic_block_->instructions().begin();
+  for (size_t i = 0; i < 2; ++i) {
+    ASSERT_TRUE(iter_inst->representation().opcode == I_PUSH);
+    EXPECT_EQ(i, iter_inst->representation().imm.dword);
+    ++iter_inst;
+    ASSERT_TRUE(iter_inst->representation().opcode == I_PUSH);
+    ASSERT_EQ(1u, iter_inst->references().size());
+    EXPECT_EQ(counter_data, iter_inst->references().begin()->second.block());
+    ++iter_inst;
+    ASSERT_TRUE(iter_inst->representation().opcode == I_CALL);
+    ASSERT_EQ(1u, iter_inst->references().size());
+    EXPECT_EQ(counter_hook, iter_inst->references().begin()->second.block());
+    std::advance(iter_inst, 4);
+  }
+  EXPECT_TRUE(iter_inst == basic_block_->instructions().end());
+
+  // The checked instructions are recorded in order.
+  ASSERT_EQ(2u, check_sites.size());
+  EXPECT_EQ(range1.start(), check_sites[0].start());
+  EXPECT_EQ(range1.size(), check_sites[0].size());
+  EXPECT_EQ(range2.start(), check_sites[1].start());
+  EXPECT_EQ(range2.size(), check_sites[1].size());
+}
+
+TEST_F(AsanTransformTest, InjectAsanHooksWithDeadEdx) {
+  // Add a read access to the memory, which defines EDX.
+  bb_asm_->mov(core::edx, block_graph::Operand(core::ebx));
+  // Add a read access to the memory, after which EDX is still live.
+  bb_asm_->mov(core::eax, block_graph::Operand(core::ecx));
+
+  // Instrument this basic block.
+  InitHooksRefs();
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.set_use_liveness_analysis(true);
+  ASSERT_TRUE(bb_transform.InstrumentBasicBlock(
+      basic_block_, AsanBasicBlockTransform::kSafeStackAccess));
+
+  // The first access doesn't need to save EDX, the second one does.
+  ASSERT_EQ(2u + 2 + 3, basic_block_->instructions().size());
+  BasicBlock::Instructions::const_iterator iter_inst =
+      basic_block_->instructions().begin();
+
+  ASSERT_TRUE((iter_inst++)->representation().opcode == I_LEA);
+  ASSERT_EQ(1u, iter_inst->references().size());
+  HookMapEntryKey check_no_edx_key =
+      { AsanBasicBlockTransform::kReadAccess, 4, 0, true, true };
+  ASSERT_TRUE(iter_inst->references().begin()->second.block()
+      == hooks_check_access_[check_no_edx_key]);
+  ASSERT_TRUE((iter_inst++)->representation().opcode == I_CALL);
+  ASSERT_TRUE((iter_inst++)->representation().opcode == I_MOV);
+
+  ASSERT_TRUE((iter_inst++)->representation().opcode == I_PUSH);
+  ASSERT_TRUE((iter_inst++)->representation().opcode == I_LEA);
+  ASSERT_EQ(1u, iter_inst->references().size());
+  HookMapEntryKey check_key =
+      { AsanBasicBlockTransform::kReadAccess, 4, 0, true, false };
+  ASSERT_TRUE(iter_inst->references().begin()->second.block()
+      == hooks_check_access_[check_key]);
+  ASSERT_TRUE((iter_inst++)->representation().opcode == I_CALL);
+  ASSERT_TRUE((iter_inst++)->representation().opcode == I_MOV);
+
+  ASSERT_TRUE(iter_inst == basic_block_->instructions().end());
+}
+
 TEST_F(AsanTransformTest, InjectAsanHooksWithSourceRange) {
   // Add a read access to the memory.
   bb_asm_->mov(core::eax, block_graph::Operand(core::ebx));
@@ -404,6 +669,353 @@ TEST_F(AsanTransformTest, InstrumentAndRemoveRedundantChecks) {
   ASSERT_EQ(basic_block_->instructions().size(), expected_instructions_count);
 }
 
+TEST_F(AsanTransformTest, InstrumentLoopWithoutHoisting) {
+  BasicBlockSubGraph subgraph;
+  BasicCodeBlock* bb_entry = NULL;
+  BasicCodeBlock* bb_loop = NULL;
+  ASSERT_NO_FATAL_FAILURE(BuildLoop(&subgraph, &bb_entry, &bb_loop));
+
+  InitHooksRefs();
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.set_remove_redundant_checks(true);
+  ASSERT_TRUE(bb_transform.TransformBasicBlockSubGraph(
+      &policy_, &block_graph_, &subgraph));
+
+  // Every access is checked in its own basic block, on every iteration.
+  EXPECT_EQ(1u + 3, bb_entry->instructions().size());
+  EXPECT_EQ(2u + 2 * 3, bb_loop->instructions().size());
+}
+
+TEST_F(AsanTransformTest, HoistLoopInvariantChecks) {
+  BasicBlockSubGraph subgraph;
+  BasicCodeBlock* bb_entry = NULL;
+  BasicCodeBlock* bb_loop = NULL;
+  ASSERT_NO_FATAL_FAILURE(BuildLoop(&subgraph, &bb_entry, &bb_loop));
+
+  InitHooksRefs();
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.set_remove_redundant_checks(true);
+  bb_transform.set_hoist_invariant_checks(true);
+  ASSERT_TRUE(bb_transform.TransformBasicBlockSubGraph(
+      &policy_, &block_graph_, &subgraph));
+
+  // The loop-invariant accesses are checked once, on entry to the loop.
+  EXPECT_EQ(2u, bb_loop->instructions().size());
+  ASSERT_EQ(1u + 3 * 3, bb_entry->instructions().size());
+
+  BasicBlock::Instructions::const_iterator iter_inst =
+      bb_entry->instructions().begin();
+  std::advance(iter_inst, 4);
+
+  HookMapEntryKey check_4_byte_read_key =
+      { AsanBasicBlockTransform::kReadAccess, 4, 0, true };
+  EXPECT_TRUE((iter_inst++)->representation().opcode == I_PUSH);
+  EXPECT_TRUE((iter_inst++)->representation().opcode == I_LEA);
+  ASSERT_EQ(1u, iter_inst->references().size());
+  EXPECT_EQ(hooks_check_access_[check_4_byte_read_key],
+            iter_inst->references().begin()->second.block());
+  EXPECT_TRUE((iter_inst++)->representation().opcode == I_CALL);
+
+  HookMapEntryKey check_4_byte_write_key =
+      { AsanBasicBlockTransform::kWriteAccess, 4, 0, true };
+  EXPECT_TRUE((iter_inst++)->representation().opcode == I_PUSH);
+  EXPECT_TRUE((iter_inst++)->representation().opcode == I_LEA);
+  ASSERT_EQ(1u, iter_inst->references().size());
+  EXPECT_EQ(hooks_check_access_[check_4_byte_write_key],
+            iter_inst->references().begin()->second.block());
+  EXPECT_TRUE((iter_inst++)->representation().opcode == I_CALL);
+
+  EXPECT_TRUE(iter_inst == bb_entry->instructions().end());
+}
+
+TEST_F(AsanTransformTest, InlineFastPath) {
+  BasicBlockSubGraph subgraph;
+  BasicBlockSubGraph::BlockDescription* block =
+      subgraph.AddBlockDescription("b1", "b1.obj", BlockGraph::CODE_BLOCK,
+                                   7, 2, 42);
+  BasicCodeBlock* bb = subgraph.AddBasicCodeBlock("bb");
+  block->basic_block_order.push_back(bb);
+
+  // Read some memory, and then use EDX while overwriting the flags.
+  block_graph::BasicBlockAssembler bb_asm(bb->instructions().end(),
+                                          &bb->instructions());
+  bb_asm.mov(core::eax, block_graph::Operand(core::ebx));
+  bb_asm.add(core::eax, core::edx);
+
+  InitHooksRefs();
+  BlockGraph::Block* shadow_memory =
+      block_graph_.AddBlock(BlockGraph::DATA_BLOCK, 4, "shadow_memory");
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.set_use_liveness_analysis(true);
+  bb_transform.set_inline_fast_path(true);
+  bb_transform.set_shadow_memory(BlockGraph::Reference(
+      BlockGraph::ABSOLUTE_REF, 4, shadow_memory, 0, 0));
+  ASSERT_TRUE(bb_transform.TransformBasicBlockSubGraph(
+      &policy_, &block_graph_, &subgraph));
+
+  // The basic block is split right before the access, and the slow path is
+  // laid out last.
+  ASSERT_EQ(3u, block->basic_block_order.size());
+  BasicBlockSubGraph::BasicBlockOrdering::iterator bb_iter =
+      block->basic_block_order.begin();
+  EXPECT_EQ(bb, *bb_iter);
+  BasicCodeBlock* tail = BasicCodeBlock::Cast(*++bb_iter);
+  BasicCodeBlock* slow_path = BasicCodeBlock::Cast(*++bb_iter);
+  ASSERT_TRUE(tail != NULL);
+  ASSERT_TRUE(slow_path != NULL);
+
+  // The fast path tests the shadow byte of the access, preserving EDX.
+  // The shadow memory is reached through the pointer it exports.
+  ASSERT_EQ(11u, bb->instructions().size());
+  BasicBlock::Instructions::const_iterator iter_inst =
+      bb->instructions().begin();
+  EXPECT_TRUE((iter_inst++)->representation().opcode == I_PUSH);
+  EXPECT_TRUE((iter_inst++)->representation().opcode == I_LEA);
+  EXPECT_TRUE((iter_inst++)->representation().opcode == I_SHR);
+  EXPECT_TRUE((iter_inst++)->representation().opcode == I_PUSH);
+  ASSERT_EQ(1u, iter_inst->references().size());
+  EXPECT_EQ(shadow_memory, iter_inst->references().begin()->second.block());
+  EXPECT_TRUE((iter_inst++)->representation().opcode == I_MOV);
+  EXPECT_TRUE((iter_inst++)->representation().opcode == I_MOV);
+  EXPECT_TRUE((iter_inst++)->representation().opcode == I_ADD);
+  EXPECT_TRUE((iter_inst++)->representation().opcode == I_POP);
+  EXPECT_TRUE((iter_inst++)->representation().opcode == I_MOVZX);
+  EXPECT_TRUE((iter_inst++)->representation().opcode == I_TEST);
+  EXPECT_TRUE((iter_inst++)->representation().opcode == I_POP);
+
+  ASSERT_EQ(2u, bb->successors().size());
+  EXPECT_EQ(Successor::kConditionNotEqual, bb->successors()[0].condition());
+  EXPECT_EQ(slow_path, bb->successors()[0].reference().basic_block());
+  EXPECT_EQ(Successor::kConditionEqual, bb->successors()[1].condition());
+  EXPECT_EQ(tail, bb->successors()[1].reference().basic_block());
+
+  // The slow path calls the hook that doesn't save the flags.
+  ASSERT_EQ(3u, slow_path->instructions().size());
+  iter_inst = slow_path->instructions().begin();
+  EXPECT_TRUE((iter_inst++)->representation().opcode == I_PUSH);
+  EXPECT_TRUE((iter_inst++)->representation().opcode == I_LEA);
+  HookMapEntryKey check_key =
+      { AsanBasicBlockTransform::kReadAccess, 4, 0, false, false };
+  ASSERT_EQ(1u, iter_inst->references().size());
+  EXPECT_EQ(hooks_check_access_[check_key],
+            iter_inst->references().begin()->second.block());
+  EXPECT_TRUE((iter_inst++)->representation().opcode == I_CALL);
+
+  ASSERT_EQ(1u, slow_path->successors().size());
+  EXPECT_EQ(Successor::kConditionTrue,
+            slow_path->successors()[0].condition());
+  EXPECT_EQ(tail, slow_path->successors()[0].reference().basic_block());
+
+  // The access itself is left untouched.
+  ASSERT_EQ(2u, tail->instructions().size());
+  EXPECT_TRUE(tail->instructions().front().representation().opcode == I_MOV);
+  EXPECT_TRUE(tail->successors().empty());
+}
+
+TEST_F(AsanTransformTest, InlineFastPathRespectsInlineFilter) {
+  BasicBlockSubGraph subgraph;
+  BasicBlockSubGraph::BlockDescription* block =
+      subgraph.AddBlockDescription("b1", "b1.obj", BlockGraph::CODE_BLOCK,
+                                   7, 2, 42);
+  BasicCodeBlock* bb = subgraph.AddBasicCodeBlock("bb");
+  block->basic_block_order.push_back(bb);
+
+  block_graph::BasicBlockAssembler bb_asm(bb->instructions().end(),
+                                          &bb->instructions());
+  bb_asm.mov(core::eax, block_graph::Operand(core::ebx));
+  bb_asm.add(core::eax, core::edx);
+  bb->instructions().front().set_source_range(
+      Instruction::SourceRange(RelativeAddress(1000), 2));
+
+  // The access isn't marked in the filter, so it gets a regular check.
+  RelativeAddressFilter filter(RelativeAddressFilter::Range(
+      RelativeAddress(0), 2000));
+  filter.Mark(RelativeAddressFilter::Range(RelativeAddress(1500), 10));
+
+  InitHooksRefs();
+  BlockGraph::Block* shadow_memory =
+      block_graph_.AddBlock(BlockGraph::DATA_BLOCK, 4, "shadow_memory");
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.set_use_liveness_analysis(true);
+  bb_transform.set_inline_fast_path(true);
+  bb_transform.set_inline_filter(&filter);
+  bb_transform.set_shadow_memory(BlockGraph::Reference(
+      BlockGraph::ABSOLUTE_REF, 4, shadow_memory, 0, 0));
+  ASSERT_TRUE(bb_transform.TransformBasicBlockSubGraph(
+      &policy_, &block_graph_, &subgraph));
+
+  EXPECT_EQ(1u, block->basic_block_order.size());
+  EXPECT_EQ(2u + 3, bb->instructions().size());
+  EXPECT_TRUE(bb->successors().empty());
+}
+
+TEST_F(AsanTransformTest, InlineFastPathInHotBasicBlocks) {
+  BasicBlockSubGraph subgraph;
+  BasicBlockSubGraph::BlockDescription* block =
+      subgraph.AddBlockDescription("b1", "b1.obj", BlockGraph::CODE_BLOCK,
+                                   7, 2, 42);
+  BasicCodeBlock* bb = subgraph.AddBasicCodeBlock("bb");
+  block->basic_block_order.push_back(bb);
+
+  block_graph::BasicBlockAssembler bb_asm(bb->instructions().end(),
+                                          &bb->instructions());
+  bb_asm.mov(core::eax, block_graph::Operand(core::ebx));
+  bb_asm.add(core::eax, core::edx);
+  bb->instructions().front().set_source_range(
+      Instruction::SourceRange(RelativeAddress(1000), 2));
+
+  // The basic block is hot, so the fast path is inlined even though it isn't
+  // requested.
+  RelativeAddressFilter hot_filter(RelativeAddressFilter::Range(
+      RelativeAddress(0), 2000));
+  hot_filter.Mark(RelativeAddressFilter::Range(RelativeAddress(1000), 1));
+
+  InitHooksRefs();
+  BlockGraph::Block* shadow_memory =
+      block_graph_.AddBlock(BlockGraph::DATA_BLOCK, 4, "shadow_memory");
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.set_use_liveness_analysis(true);
+  bb_transform.set_hot_filter(&hot_filter);
+  bb_transform.set_shadow_memory(BlockGraph::Reference(
+      BlockGraph::ABSOLUTE_REF, 4, shadow_memory, 0, 0));
+  ASSERT_TRUE(bb_transform.TransformBasicBlockSubGraph(
+      &policy_, &block_graph_, &subgraph));
+
+  EXPECT_EQ(3u, block->basic_block_order.size());
+  EXPECT_EQ(2u, bb->successors().size());
+}
+
+TEST_F(AsanTransformTest, StackAccessesAtConstantOffsetsNotInstrumented) {
+  // mov eax, [esp + 4]
+  bb_asm_->mov(core::eax, block_graph::Operand(
+      core::esp, block_graph::Displacement(4, core::kSize8Bit)));
+  // mov eax, [esp + ebx * 4 + 4]
+  bb_asm_->mov(core::eax, block_graph::Operand(
+      core::esp, core::ebx, core::kTimes4,
+      block_graph::Displacement(4, core::kSize8Bit)));
+  // mov eax, [ebp + 4]
+  bb_asm_->mov(core::eax, block_graph::Operand(
+      core::ebp, block_graph::Displacement(4, core::kSize8Bit)));
+
+  // Even with an unsafe stack frame, ESP points to the stack. Only the
+  // indexed access and the one through EBP are checked.
+  InitHooksRefs();
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  ASSERT_TRUE(bb_transform.InstrumentBasicBlock(
+        basic_block_, AsanBasicBlockTransform::kUnsafeStackAccess));
+
+  EXPECT_EQ(2u, bb_transform.stats().num_emitted);
+  EXPECT_EQ(1u, bb_transform.stats().num_stack_elided);
+  EXPECT_EQ(1u, bb_transform.stats().num_elided());
+}
+
+TEST_F(AsanTransformTest, ClassifyAccesses) {
+  BlockGraph::Block* data =
+      block_graph_.AddBlock(BlockGraph::DATA_BLOCK, 4, "data");
+  _DInst repr = {};
+
+  struct ClassifiedOperand {
+    block_graph::Operand operand;
+    // The expected kinds with an unsafe and a safe stack frame.
+    AsanBasicBlockTransform::SafeAccessKind unsafe_stack_kind;
+    AsanBasicBlockTransform::SafeAccessKind safe_stack_kind;
+  };
+  const ClassifiedOperand kOperands[] = {
+    // [data]
+    { block_graph::Operand(block_graph::Displacement(data, 0)),
+      AsanBasicBlockTransform::kImageAccess,
+      AsanBasicBlockTransform::kImageAccess },
+    // [ebx * 4 + data]
+    { block_graph::Operand(core::ebx, core::kTimes4,
+                           block_graph::Displacement(data, 0)),
+      AsanBasicBlockTransform::kImageAccess,
+      AsanBasicBlockTransform::kImageAccess },
+    // [esp + 8]
+    { block_graph::Operand(core::esp,
+                           block_graph::Displacement(8, core::kSize8Bit)),
+      AsanBasicBlockTransform::kStackAccess,
+      AsanBasicBlockTransform::kStackAccess },
+    // [ebp - 8]
+    { block_graph::Operand(core::ebp,
+                           block_graph::Displacement(-8, core::kSize8Bit)),
+      AsanBasicBlockTransform::kUnsafeAccess,
+      AsanBasicBlockTransform::kStackAccess },
+    // [ebx]
+    { block_graph::Operand(core::ebx),
+      AsanBasicBlockTransform::kUnsafeAccess,
+      AsanBasicBlockTransform::kUnsafeAccess },
+  };
+
+  for (size_t i = 0; i < arraysize(kOperands); ++i) {
+    EXPECT_EQ(kOperands[i].unsafe_stack_kind,
+              AsanBasicBlockTransform::ClassifyAccess(
+                  kOperands[i].operand, repr,
+                  AsanBasicBlockTransform::kUnsafeStackAccess));
+    EXPECT_EQ(kOperands[i].safe_stack_kind,
+              AsanBasicBlockTransform::ClassifyAccess(
+                  kOperands[i].operand, repr,
+                  AsanBasicBlockTransform::kSafeStackAccess));
+  }
+
+  // fs:[ebx]
+  repr.segment = R_FS;
+  EXPECT_EQ(AsanBasicBlockTransform::kSegmentAccess,
+            AsanBasicBlockTransform::ClassifyAccess(
+                block_graph::Operand(core::ebx), repr,
+                AsanBasicBlockTransform::kUnsafeStackAccess));
+}
+
+TEST_F(AsanTransformTest, InstrumentNoAccessWithZeroRate) {
+  const size_t kNumAccesses = 100;
+  ASSERT_NO_FATAL_FAILURE(AddSourcedAccesses(kNumAccesses));
+
+  InitHooksRefs();
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.set_instrumentation_rate(0.0);
+  ASSERT_TRUE(bb_transform.InstrumentBasicBlock(
+      basic_block_, AsanBasicBlockTransform::kSafeStackAccess));
+
+  EXPECT_EQ(2 * kNumAccesses, basic_block_->instructions().size());
+}
+
+TEST_F(AsanTransformTest, InstrumentSampledAccesses) {
+  const size_t kNumAccesses = 100;
+  ASSERT_NO_FATAL_FAILURE(AddSourcedAccesses(kNumAccesses));
+  BasicBlock::Instructions original_instructions(basic_block_->instructions());
+
+  InitHooksRefs();
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.set_instrumentation_rate(0.5);
+  bb_transform.set_instrumentation_seed(1);
+  ASSERT_TRUE(bb_transform.InstrumentBasicBlock(
+      basic_block_, AsanBasicBlockTransform::kSafeStackAccess));
+
+  // Roughly half of the accesses are instrumented.
+  std::set<RelativeAddress> accesses;
+  ASSERT_NO_FATAL_FAILURE(GetInstrumentedAccesses(&accesses));
+  EXPECT_LT(kNumAccesses / 4, accesses.size());
+  EXPECT_GT(3 * kNumAccesses / 4, accesses.size());
+
+  // The selection only depends on the seed.
+  basic_block_->instructions() = original_instructions;
+  ASSERT_TRUE(bb_transform.InstrumentBasicBlock(
+      basic_block_, AsanBasicBlockTransform::kSafeStackAccess));
+  std::set<RelativeAddress> same_seed_accesses;
+  ASSERT_NO_FATAL_FAILURE(GetInstrumentedAccesses(&same_seed_accesses));
+  EXPECT_EQ(accesses, same_seed_accesses);
+
+  // While another seed selects other accesses, at the same rate.
+  basic_block_->instructions() = original_instructions;
+  bb_transform.set_instrumentation_seed(2);
+  ASSERT_TRUE(bb_transform.InstrumentBasicBlock(
+      basic_block_, AsanBasicBlockTransform::kSafeStackAccess));
+  std::set<RelativeAddress> other_seed_accesses;
+  ASSERT_NO_FATAL_FAILURE(GetInstrumentedAccesses(&other_seed_accesses));
+  EXPECT_LT(kNumAccesses / 4, other_seed_accesses.size());
+  EXPECT_GT(3 * kNumAccesses / 4, other_seed_accesses.size());
+  EXPECT_NE(accesses, other_seed_accesses);
+}
+
 TEST_F(AsanTransformTest, NonInstrumentableStackBasedInstructions) {
   // DEC DWORD [EBP - 0x2830]
   static const uint8 kDec1[6] = { 0xff, 0x8d, 0xd0, 0xd7, 0xff, 0xff };
@@ -754,6 +1366,36 @@ TEST_F(AsanTransformTest, ImportsAreRedirected) {
   expected.insert("asan_check_16_byte_write_access_no_flags");
   expected.insert("asan_check_32_byte_write_access_no_flags");
 
+  expected.insert("asan_check_1_byte_read_access_no_edx");
+  expected.insert("asan_check_2_byte_read_access_no_edx");
+  expected.insert("asan_check_4_byte_read_access_no_edx");
+  expected.insert("asan_check_8_byte_read_access_no_edx");
+  expected.insert("asan_check_10_byte_read_access_no_edx");
+  expected.insert("asan_check_16_byte_read_access_no_edx");
+  expected.insert("asan_check_32_byte_read_access_no_edx");
+  expected.insert("asan_check_1_byte_write_access_no_edx");
+  expected.insert("asan_check_2_byte_write_access_no_edx");
+  expected.insert("asan_check_4_byte_write_access_no_edx");
+  expected.insert("asan_check_8_byte_write_access_no_edx");
+  expected.insert("asan_check_10_byte_write_access_no_edx");
+  expected.insert("asan_check_16_byte_write_access_no_edx");
+  expected.insert("asan_check_32_byte_write_access_no_edx");
+
+  expected.insert("asan_check_1_byte_read_access_no_edx_no_flags");
+  expected.insert("asan_check_2_byte_read_access_no_edx_no_flags");
+  expected.insert("asan_check_4_byte_read_access_no_edx_no_flags");
+  expected.insert("asan_check_8_byte_read_access_no_edx_no_flags");
+  expected.insert("asan_check_10_byte_read_access_no_edx_no_flags");
+  expected.insert("asan_check_16_byte_read_access_no_edx_no_flags");
+  expected.insert("asan_check_32_byte_read_access_no_edx_no_flags");
+  expected.insert("asan_check_1_byte_write_access_no_edx_no_flags");
+  expected.insert("asan_check_2_byte_write_access_no_edx_no_flags");
+  expected.insert("asan_check_4_byte_write_access_no_edx_no_flags");
+  expected.insert("asan_check_8_byte_write_access_no_edx_no_flags");
+  expected.insert("asan_check_10_byte_write_access_no_edx_no_flags");
+  expected.insert("asan_check_16_byte_write_access_no_edx_no_flags");
+  expected.insert("asan_check_32_byte_write_access_no_edx_no_flags");
+
   expected.insert("asan_check_repz_4_byte_cmps_access");
   expected.insert("asan_check_repz_4_byte_movs_access");
   expected.insert("asan_check_repz_4_byte_stos_access");
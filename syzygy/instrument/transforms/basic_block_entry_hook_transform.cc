@@ -132,7 +132,8 @@ BasicBlockEntryHookTransform::BasicBlockEntryHookTransform()
     thunk_section_(NULL),
     instrument_dll_name_(kDefaultModuleName),
     set_src_ranges_for_thunks_(false),
-    set_inline_fast_path_(false) {
+    set_inline_fast_path_(false),
+    frequency_size_(sizeof(uint32)) {
 }
 
 bool BasicBlockEntryHookTransform::PreBlockGraphIteration(
@@ -264,7 +265,7 @@ bool BasicBlockEntryHookTransform::PostBlockGraphIteration(
 
   if (!add_frequency_data_.ConfigureFrequencyDataBuffer(num_basic_blocks,
                                                         1,
-                                                        sizeof(uint32))) {
+                                                        frequency_size_)) {
     LOG(ERROR) << "Failed to configure frequency data buffer.";
     return false;
   }
@@ -81,6 +81,17 @@ class BasicBlockEntryHookTransform
     set_inline_fast_path_ = value;
   }
 
+  // Returns the size, in bytes, of each basic-block entry counter.
+  uint8 frequency_size() const { return frequency_size_; }
+
+  // Set the size, in bytes, of each basic-block entry counter: 1, 2 or 4.
+  // Narrower counters shrink the frequency data and the cache footprint of
+  // hot code; the agent spills the counts they overflow to a side table.
+  void set_frequency_size(uint8 value) {
+    DCHECK(value == 1 || value == 2 || value == 4);
+    frequency_size_ = value;
+  }
+
  protected:
   typedef std::map<BlockGraph::Offset, BlockGraph::Block*> ThunkBlockMap;
 
@@ -179,6 +190,9 @@ class BasicBlockEntryHookTransform
   // falling back to the hook in the agent.
   bool set_inline_fast_path_;
 
+  // The size, in bytes, of each basic-block entry counter.
+  uint8 frequency_size_;
+
   // The name of this transform.
   static const char kTransformName[];
 
@@ -193,6 +193,14 @@ TEST_F(BasicBlockEntryHookTransformTest, SetInlinePathFlag) {
   EXPECT_FALSE(tx_.inline_fast_path());
 }
 
+TEST_F(BasicBlockEntryHookTransformTest, SetFrequencySize) {
+  EXPECT_EQ(sizeof(uint32), tx_.frequency_size());
+  tx_.set_frequency_size(1);
+  EXPECT_EQ(1U, tx_.frequency_size());
+  tx_.set_frequency_size(2);
+  EXPECT_EQ(2U, tx_.frequency_size());
+}
+
 TEST_F(BasicBlockEntryHookTransformTest, ApplyAgentInstrumentation) {
   ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
 
@@ -226,5 +234,27 @@ TEST_F(BasicBlockEntryHookTransformTest, ApplyAgentInstrumentation) {
   CheckBasicBlockInstrumentation(kAgentInstrumentation);
 }
 
+TEST_F(BasicBlockEntryHookTransformTest, ApplyAgentInstrumentationNarrow) {
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
+
+  // Apply the transform with 8-bit counters.
+  tx_.set_frequency_size(1);
+  ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+      &tx_, &policy_, &block_graph_, dos_header_block_));
+  ASSERT_TRUE(tx_.frequency_data_block() != NULL);
+  ASSERT_LT(0u, tx_.bb_ranges().size());
+
+  // The frequency data buffer shrinks accordingly.
+  block_graph::ConstTypedBlock<IndexedFrequencyData> frequency_data;
+  ASSERT_TRUE(frequency_data.Init(0, tx_.frequency_data_block()));
+  EXPECT_EQ(1U, frequency_data->frequency_size);
+  EXPECT_EQ(tx_.bb_ranges().size(), frequency_data->num_entries);
+  EXPECT_EQ(frequency_data->num_entries,
+            tx_.frequency_data_buffer_block()->size());
+
+  // The instrumentation itself is unchanged.
+  CheckBasicBlockInstrumentation(kAgentInstrumentation);
+}
+
 }  // namespace transforms
 }  // namespace instrument
@@ -26,9 +26,12 @@ namespace transforms {
 
 namespace {
 
+using common::EdgeCoverageData;
 using common::IndexedFrequencyData;
 using common::kBasicBlockCoverageAgentId;
+using common::kEdgeCoverageBitmapSize;
 using core::eax;
+using core::ecx;
 using block_graph::ApplyBasicBlockSubGraphTransform;
 using block_graph::ApplyBlockGraphTransform;
 using block_graph::BasicBlock;
@@ -46,6 +49,19 @@ typedef CoverageInstrumentationTransform::RelativeAddressRange
 
 const BlockGraph::Offset kFrequencyDataOffset =
     offsetof(IndexedFrequencyData, frequency_data);
+const BlockGraph::Offset kPreviousLocationOffset =
+    offsetof(EdgeCoverageData, previous_location);
+
+// Returns a pseudo-random location in [0, kEdgeCoverageBitmapSize / 2) for the
+// basic block of index @p bb_index. Distinct @p salt values give independent
+// locations. This is deterministic so that instrumenting is reproducible.
+uint32 GetEdgeLocation(size_t bb_index, uint32 salt) {
+  // A multiplicative hash, keeping the high bits.
+  uint32 hash = (static_cast<uint32>(bb_index) ^ salt) * 2654435761U;
+  uint32 location = hash >> 16;
+  DCHECK_EQ(1U << 16, kEdgeCoverageBitmapSize);
+  return location >> 1;
+}
 
 // Compares two relative address ranges to see if they overlap. Assumes they
 // are already sorted. This is used to validate basic-block ranges.
@@ -71,12 +87,35 @@ CoverageInstrumentationTransform::CoverageInstrumentationTransform()
                            "Basic-Block Frequency Data",
                            common::kBasicBlockFrequencyDataVersion,
                            common::IndexedFrequencyData::COVERAGE,
-                           sizeof(common::IndexedFrequencyData)) {
+                           sizeof(common::IndexedFrequencyData)),
+      edge_coverage_(false),
+      page_coverage_(false) {
   // Initialize the EntryThunkTransform.
   entry_thunk_tx_.set_instrument_unsafe_references(false);
   entry_thunk_tx_.set_only_instrument_module_entry(true);
 }
 
+void CoverageInstrumentationTransform::set_edge_coverage(bool value) {
+  DCHECK(!value || !page_coverage_);
+  edge_coverage_ = value;
+  if (edge_coverage_) {
+    add_bb_freq_data_tx_.set_data_type(IndexedFrequencyData::EDGE_COVERAGE);
+    add_bb_freq_data_tx_.set_indexed_frequency_data_size(
+        sizeof(EdgeCoverageData));
+  } else {
+    add_bb_freq_data_tx_.set_data_type(IndexedFrequencyData::COVERAGE);
+    add_bb_freq_data_tx_.set_indexed_frequency_data_size(
+        sizeof(IndexedFrequencyData));
+  }
+}
+
+void CoverageInstrumentationTransform::set_page_coverage(bool value) {
+  DCHECK(!value || !edge_coverage_);
+  page_coverage_ = value;
+  add_bb_freq_data_tx_.set_data_type(value ?
+      IndexedFrequencyData::PAGE_COVERAGE : IndexedFrequencyData::COVERAGE);
+}
+
 bool CoverageInstrumentationTransform::TransformBasicBlockSubGraph(
     const TransformPolicyInterface* policy,
     BlockGraph* block_graph,
@@ -87,7 +126,9 @@ bool CoverageInstrumentationTransform::TransformBasicBlockSubGraph(
 
   BlockGraph::Block* data_block = add_bb_freq_data_tx_.frequency_data_block();
   DCHECK(data_block != NULL);
-  DCHECK_EQ(sizeof(IndexedFrequencyData), data_block->data_size());
+  DCHECK_EQ(edge_coverage_ ? sizeof(EdgeCoverageData) :
+                sizeof(IndexedFrequencyData),
+            data_block->data_size());
 
   // Iterate over the basic blocks.
   BasicBlockSubGraph::BBCollection::iterator it =
@@ -106,18 +147,47 @@ bool CoverageInstrumentationTransform::TransformBasicBlockSubGraph(
       return false;
     }
 
-    // We prepend each basic code block with the following instructions:
-    //   0. push eax
-    //   1. mov eax, dword ptr[data.frequency_data]
-    //   2. mov byte ptr[eax + basic_block_index], 1
-    //   3. pop eax
     BasicBlockAssembler assm(bb->instructions().begin(), &bb->instructions());
 
-    // Prepend the instrumentation instructions.
-    assm.push(eax);
-    assm.mov(eax, Operand(Displacement(data_block, kFrequencyDataOffset)));
-    assm.mov_b(Operand(eax, Displacement(bb_ranges_.size())), Immediate(1));
-    assm.pop(eax);
+    if (edge_coverage_) {
+      // We prepend each basic code block with the following instructions,
+      // which leave the flags untouched:
+      //   0. push eax
+      //   1. push ecx
+      //   2. mov eax, dword ptr[data.frequency_data]
+      //   3. mov ecx, dword ptr[data.previous_location]
+      //   4. mov byte ptr[eax + ecx + location], 1
+      //   5. mov dword ptr[data.previous_location], previous_location
+      //   6. pop ecx
+      //   7. pop eax
+      // Both locations are below half of the bitmap, so their sum needs no
+      // masking. Giving each basic block distinct locations as the source and
+      // as the destination of an edge keeps A->B and B->A apart.
+      uint32 location = GetEdgeLocation(bb_ranges_.size(), 0);
+      uint32 previous_location =
+          GetEdgeLocation(bb_ranges_.size(), 0x9E3779B9);
+      assm.push(eax);
+      assm.push(ecx);
+      assm.mov(eax, Operand(Displacement(data_block, kFrequencyDataOffset)));
+      assm.mov(ecx,
+               Operand(Displacement(data_block, kPreviousLocationOffset)));
+      assm.mov_b(Operand(eax, ecx, core::kTimes1, Displacement(location)),
+                 Immediate(1));
+      assm.mov(Operand(Displacement(data_block, kPreviousLocationOffset)),
+               Immediate(previous_location, core::kSize32Bit));
+      assm.pop(ecx);
+      assm.pop(eax);
+    } else {
+      // We prepend each basic code block with the following instructions:
+      //   0. push eax
+      //   1. mov eax, dword ptr[data.frequency_data]
+      //   2. mov byte ptr[eax + basic_block_index], 1
+      //   3. pop eax
+      assm.push(eax);
+      assm.mov(eax, Operand(Displacement(data_block, kFrequencyDataOffset)));
+      assm.mov_b(Operand(eax, Displacement(bb_ranges_.size())), Immediate(1));
+      assm.pop(eax);
+    }
 
     bb_ranges_.push_back(source_range);
   }
@@ -150,8 +220,9 @@ bool CoverageInstrumentationTransform::OnBlock(
   DCHECK(block_graph != NULL);
   DCHECK(block != NULL);
 
-  // We only care about code blocks.
-  if (block->type() != BlockGraph::CODE_BLOCK)
+  // We only care about code blocks, and leave them alone in page coverage
+  // mode.
+  if (block->type() != BlockGraph::CODE_BLOCK || page_coverage_)
     return true;
 
   // We only care about blocks that are safe for basic block decomposition.
@@ -188,13 +259,30 @@ bool CoverageInstrumentationTransform::PostBlockGraphIteration(
     return false;
   }
 
+  // The agent sizes the page coverage bitmap from the image at run-time. A
+  // single entry is reserved so that the data is valid until it does.
+  if (page_coverage_) {
+    if (!add_bb_freq_data_tx_.ConfigureFrequencyDataBuffer(1, 1,
+                                                           sizeof(uint8))) {
+      LOG(ERROR) << "Failed to configure frequency data buffer.";
+      return false;
+    }
+    return true;
+  }
+
   size_t num_basic_blocks = bb_ranges_.size();
   if (num_basic_blocks == 0) {
     LOG(WARNING) << "Encountered no basic code blocks during instrumentation.";
     return true;
   }
 
-  if (!add_bb_freq_data_tx_.ConfigureFrequencyDataBuffer(num_basic_blocks,
+  // The edge coverage bitmap has a fixed size, whatever the number of basic
+  // blocks.
+  size_t num_entries = num_basic_blocks;
+  if (edge_coverage_)
+    num_entries = kEdgeCoverageBitmapSize;
+
+  if (!add_bb_freq_data_tx_.ConfigureFrequencyDataBuffer(num_entries,
                                                          1,
                                                          sizeof(uint8))) {
     LOG(ERROR) << "Failed to configure frequency data buffer.";
@@ -19,6 +19,13 @@
 // (2) Grabs an entry hook and wires it up the run-time library.
 // (3) Adds a read/write data section containing code coverage information.
 // (4) Instruments each basic block to gather basic block visit information.
+//
+// In edge coverage mode, each basic block instead marks the entry of the
+// bitmap corresponding to the edge through which it was entered.
+//
+// In page coverage mode, step (4) is skipped altogether. The agent guards the
+// code pages of the module when it is loaded, and records the pages that get
+// executed in a bitmap with one entry per page of the image.
 
 #ifndef SYZYGY_INSTRUMENT_TRANSFORMS_COVERAGE_TRANSFORM_H_
 #define SYZYGY_INSTRUMENT_TRANSFORMS_COVERAGE_TRANSFORM_H_
@@ -67,8 +74,29 @@ class CoverageInstrumentationTransform
   //      as its unique ID.
   const RelativeAddressRangeVector& bb_ranges() const { return bb_ranges_; }
 
+  // @returns true if the edges between basic blocks are recorded rather than
+  //     the basic blocks themselves.
+  bool edge_coverage() const { return edge_coverage_; }
+
+  // @returns true if the basic blocks are left alone, and the agent records
+  //     the code pages that are executed instead.
+  bool page_coverage() const { return page_coverage_; }
+
   // @}
 
+  // Enables the edge coverage mode. This must be called prior to applying the
+  // transform.
+  // @param value True to record the edges between basic blocks in a hashed
+  //     bitmap, false to record the basic blocks.
+  void set_edge_coverage(bool value);
+
+  // Enables the page coverage mode. This must be called prior to applying the
+  // transform, and is exclusive with the edge coverage mode.
+  // @param value True to leave the basic blocks uninstrumented and have the
+  //     agent record the executed code pages, false to record the basic
+  //     blocks.
+  void set_page_coverage(bool value);
+
   // @name Pass-throughs to EntryThunkTransform.
   // @{
   bool src_ranges_for_thunks() const {
@@ -127,6 +155,12 @@ class CoverageInstrumentationTransform
   // Stores the RVAs in the original image for each instrumented basic block.
   RelativeAddressRangeVector bb_ranges_;
 
+  // If true, the edges between basic blocks are recorded.
+  bool edge_coverage_;
+
+  // If true, the executed code pages are recorded by the agent.
+  bool page_coverage_;
+
   DISALLOW_COPY_AND_ASSIGN(CoverageInstrumentationTransform);
 };
 
@@ -30,6 +30,7 @@ namespace transforms {
 
 namespace {
 
+using common::EdgeCoverageData;
 using common::IndexedFrequencyData;
 using block_graph::BlockGraph;
 
@@ -67,5 +68,59 @@ TEST_F(CoverageInstrumentationTransformTest, Apply) {
       coverage_data.OffsetOf(coverage_data->frequency_data)));
 }
 
+TEST_F(CoverageInstrumentationTransformTest, ApplyEdgeCoverage) {
+  CoverageInstrumentationTransform tx;
+  EXPECT_FALSE(tx.edge_coverage());
+  tx.set_edge_coverage(true);
+  EXPECT_TRUE(tx.edge_coverage());
+  ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+      &tx, &policy_, &block_graph_, dos_header_block_));
+
+  BlockGraph::Block* frequency_data_block = tx.frequency_data_block();
+
+  block_graph::ConstTypedBlock<EdgeCoverageData> coverage_data;
+  ASSERT_TRUE(coverage_data.Init(0, frequency_data_block));
+
+  // The frequency data block holds the previous location as well.
+  ASSERT_EQ(sizeof(EdgeCoverageData), frequency_data_block->size());
+  ASSERT_EQ(sizeof(EdgeCoverageData), frequency_data_block->data_size());
+
+  // The bitmap has a fixed size.
+  const IndexedFrequencyData& module_data = coverage_data->module_data;
+  EXPECT_EQ(common::kBasicBlockCoverageAgentId, module_data.agent_id);
+  EXPECT_EQ(IndexedFrequencyData::EDGE_COVERAGE, module_data.data_type);
+  EXPECT_EQ(common::kEdgeCoverageBitmapSize, module_data.num_entries);
+  EXPECT_EQ(1U, module_data.frequency_size);
+  EXPECT_EQ(module_data.num_entries,
+            tx.frequency_data_buffer_block()->size());
+  EXPECT_EQ(0U, coverage_data->previous_location);
+
+  // The basic blocks are still recorded for the PDB stream.
+  EXPECT_LT(0U, tx.bb_ranges().size());
+}
+
+TEST_F(CoverageInstrumentationTransformTest, ApplyPageCoverage) {
+  CoverageInstrumentationTransform tx;
+  EXPECT_FALSE(tx.page_coverage());
+  tx.set_page_coverage(true);
+  EXPECT_TRUE(tx.page_coverage());
+  ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+      &tx, &policy_, &block_graph_, dos_header_block_));
+
+  block_graph::ConstTypedBlock<IndexedFrequencyData> coverage_data;
+  ASSERT_TRUE(coverage_data.Init(0, tx.frequency_data_block()));
+
+  // A single placeholder entry is reserved until the agent sizes the bitmap.
+  EXPECT_EQ(common::kBasicBlockCoverageAgentId, coverage_data->agent_id);
+  EXPECT_EQ(IndexedFrequencyData::PAGE_COVERAGE, coverage_data->data_type);
+  EXPECT_EQ(1U, coverage_data->num_entries);
+  EXPECT_EQ(1U, coverage_data->num_columns);
+  EXPECT_EQ(1U, coverage_data->frequency_size);
+  EXPECT_EQ(1U, tx.frequency_data_buffer_block()->size());
+
+  // No basic block was instrumented.
+  EXPECT_TRUE(tx.bb_ranges().empty());
+}
+
 }  // namespace transforms
 }  // namespace instrument
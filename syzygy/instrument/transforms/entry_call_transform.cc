@@ -19,6 +19,7 @@
 #include "syzygy/block_graph/basic_block_assembler.h"
 #include "syzygy/block_graph/block_builder.h"
 #include "syzygy/block_graph/block_util.h"
+#include "syzygy/block_graph/filter_util.h"
 #include "syzygy/common/defs.h"
 #include "syzygy/pe/pe_utils.h"
 #include "syzygy/pe/transforms/pe_add_imports_transform.h"
@@ -37,12 +38,31 @@ const char EntryCallTransform::kDllMainEntryHookName[] =
     "_indirect_penter_dllmain";
 const char EntryCallTransform::kExeMainEntryHookName[] =
     "_indirect_penter_exemain";
+const char EntryCallTransform::kShadowEntryHookName[] =
+    "_indirect_penter_shadow";
+const char EntryCallTransform::kShadowDllMainEntryHookName[] =
+    "_indirect_penter_shadow_dllmain";
+const char EntryCallTransform::kShadowExeMainEntryHookName[] =
+    "_indirect_penter_shadow_exemain";
+const char EntryCallTransform::kExitHookName[] = "_indirect_pexit";
 const char EntryCallTransform::kDefaultInstrumentDll[] =
     "profile_client.dll";
 
 EntryCallBasicBlockTransform::EntryCallBasicBlockTransform(
     const BlockGraph::Reference& hook_reference, bool debug_friendly)
-        : hook_reference_(hook_reference), debug_friendly_(debug_friendly) {
+        : hook_reference_(hook_reference),
+          debug_friendly_(debug_friendly),
+          min_leaf_instructions_(0) {
+}
+
+EntryCallBasicBlockTransform::EntryCallBasicBlockTransform(
+    const BlockGraph::Reference& hook_reference,
+    const BlockGraph::Reference& exit_hook_reference,
+    bool debug_friendly)
+        : debug_friendly_(debug_friendly),
+          min_leaf_instructions_(0),
+          hook_reference_(hook_reference),
+          exit_hook_reference_(exit_hook_reference) {
 }
 
 bool EntryCallBasicBlockTransform::TransformBasicBlockSubGraph(
@@ -59,6 +79,13 @@ bool EntryCallBasicBlockTransform::TransformBasicBlockSubGraph(
   // We expect to be looking into a newly-decomposed basic block graph, with
   // precisely one block description for the originating block.
   DCHECK_EQ(1U, basic_block_subgraph->block_descriptions().size());
+
+  // Small leaf functions are left as they are.
+  if (min_leaf_instructions_ != 0 &&
+      IsSmallLeafFunction(basic_block_subgraph)) {
+    return true;
+  }
+
   BasicBlockSubGraph::BasicBlockOrdering& bb_order =
       basic_block_subgraph->block_descriptions().front().basic_block_order;
 
@@ -79,6 +106,9 @@ bool EntryCallBasicBlockTransform::TransformBasicBlockSubGraph(
   DCHECK_NE(static_cast<BasicCodeBlock*>(NULL), bb);
   DCHECK_EQ(0, bb->offset());
 
+  if (exit_hook_reference_.IsValid())
+    InsertExitHooks(basic_block_subgraph);
+
   // Create a new basic block for the entry hook.
   BasicCodeBlock* entry_hook =
       basic_block_subgraph->AddBasicCodeBlock("EntryHook");
@@ -176,9 +206,73 @@ bool EntryCallBasicBlockTransform::TransformBasicBlockSubGraph(
   return true;
 }
 
+void EntryCallBasicBlockTransform::InsertExitHooks(
+    BasicBlockSubGraph* basic_block_subgraph) {
+  DCHECK_NE(static_cast<BasicBlockSubGraph*>(NULL), basic_block_subgraph);
+
+  using block_graph::BasicBlockAssembler;
+  using block_graph::BasicCodeBlock;
+  using block_graph::Displacement;
+  using block_graph::Operand;
+
+  // Functions that leave through a tail call or a call to a non-returning
+  // function get no exit hook. The profiler pops their entries on the next
+  // exit from a function further up the stack.
+  BasicBlockSubGraph::BBCollection::iterator bb_it =
+      basic_block_subgraph->basic_blocks().begin();
+  for (; bb_it != basic_block_subgraph->basic_blocks().end(); ++bb_it) {
+    BasicCodeBlock* bb = BasicCodeBlock::Cast(*bb_it);
+    if (bb == NULL)
+      continue;
+
+    BasicCodeBlock::Instructions& instructions = bb->instructions();
+    BasicCodeBlock::Instructions::iterator inst_it = instructions.begin();
+    for (; inst_it != instructions.end(); ++inst_it) {
+      if (!inst_it->IsReturn())
+        continue;
+
+      // The assembler inserts ahead of the return.
+      BasicBlockAssembler assm(inst_it, &instructions);
+      if (debug_friendly_)
+        assm.set_source_range(inst_it->source_range());
+      assm.call(Operand(Displacement(exit_hook_reference_.referenced(),
+                                     exit_hook_reference_.offset())));
+    }
+  }
+}
+
+bool EntryCallBasicBlockTransform::IsSmallLeafFunction(
+    const BasicBlockSubGraph* basic_block_subgraph) const {
+  DCHECK_NE(static_cast<BasicBlockSubGraph*>(NULL), basic_block_subgraph);
+
+  using block_graph::BasicCodeBlock;
+
+  size_t num_instructions = 0;
+  BasicBlockSubGraph::BBCollection::const_iterator bb_it =
+      basic_block_subgraph->basic_blocks().begin();
+  for (; bb_it != basic_block_subgraph->basic_blocks().end(); ++bb_it) {
+    const BasicCodeBlock* bb = BasicCodeBlock::Cast(*bb_it);
+    if (bb == NULL)
+      continue;
+
+    BasicCodeBlock::Instructions::const_iterator inst_it =
+        bb->instructions().begin();
+    for (; inst_it != bb->instructions().end(); ++inst_it) {
+      if (inst_it->IsCall())
+        return false;
+      ++num_instructions;
+    }
+  }
+
+  return num_instructions < min_leaf_instructions_;
+}
+
 EntryCallTransform::EntryCallTransform(bool debug_friendly)
     : instrument_dll_name_(kDefaultInstrumentDll),
-      debug_friendly_(debug_friendly) {
+      debug_friendly_(debug_friendly),
+      instrument_exits_(false),
+      hot_filter_(NULL),
+      min_leaf_instructions_(0) {
 }
 
 bool EntryCallTransform::PreBlockGraphIteration(
@@ -206,7 +300,9 @@ bool EntryCallTransform::PreBlockGraphIteration(
   // itself) then we need the DllMain entry hook.
   if (dllmain_entrypoints_.size() > 0) {
     import_hooks.push_back(std::make_pair(
-        import_module.AddSymbol(kDllMainEntryHookName,
+        import_module.AddSymbol(instrument_exits_ ?
+                                    kShadowDllMainEntryHookName :
+                                    kDllMainEntryHookName,
                                 ImportedModule::kAlwaysImport),
         &hook_dllmain_ref_));
   }
@@ -214,16 +310,28 @@ bool EntryCallTransform::PreBlockGraphIteration(
   // If this was an EXE then we need the EXE entry hook.
   if (exe_entry_point_.first != NULL) {
     import_hooks.push_back(std::make_pair(
-        import_module.AddSymbol(kExeMainEntryHookName,
+        import_module.AddSymbol(instrument_exits_ ?
+                                    kShadowExeMainEntryHookName :
+                                    kExeMainEntryHookName,
                                 ImportedModule::kAlwaysImport),
         &hook_exe_entry_ref_));
   }
 
   import_hooks.push_back(std::make_pair(
-      import_module.AddSymbol(kEntryHookName,
+      import_module.AddSymbol(instrument_exits_ ? kShadowEntryHookName :
+                                                  kEntryHookName,
                               ImportedModule::kAlwaysImport),
       &hook_ref_));
 
+  // The shadow entry hooks rely on the exit hook to see function exits,
+  // rather than on swizzling return addresses.
+  if (instrument_exits_) {
+    import_hooks.push_back(std::make_pair(
+        import_module.AddSymbol(kExitHookName,
+                                ImportedModule::kAlwaysImport),
+        &hook_exit_ref_));
+  }
+
   // Nothing to do if we don't need any import hooks.
   if (import_hooks.empty())
     return true;
@@ -275,6 +383,16 @@ bool EntryCallTransform::OnBlock(const TransformPolicyInterface* policy,
   // It can't be both an EXE and a DLL entry.
   DCHECK(!is_dllmain_entry || !is_exe_entry);
 
+  // The profiler learns about modules through their entry points, so these
+  // are instrumented regardless of the filters.
+  bool is_module_entry = is_dllmain_entry || is_exe_entry;
+  if (!is_module_entry) {
+    if (IsFiltered(block))
+      return true;
+    if (hot_filter_ != NULL && !IsHotOrCallsHot(block))
+      return true;
+  }
+
   // Determine which hook function to use.
   BlockGraph::Reference* hook_ref = &hook_ref_;
   if (is_dllmain_entry)
@@ -282,7 +400,11 @@ bool EntryCallTransform::OnBlock(const TransformPolicyInterface* policy,
   else if (is_exe_entry)
     hook_ref = &hook_exe_entry_ref_;
 
-  EntryCallBasicBlockTransform entry_call_transform(*hook_ref, debug_friendly_);
+  // The exit hook reference is left invalid unless exits are instrumented.
+  EntryCallBasicBlockTransform entry_call_transform(
+      *hook_ref, hook_exit_ref_, debug_friendly_);
+  if (!is_module_entry)
+    entry_call_transform.set_min_leaf_instructions(min_leaf_instructions_);
   if (!ApplyBasicBlockSubGraphTransform(
            &entry_call_transform, policy, block_graph, block, NULL)) {
     return false;
@@ -323,6 +445,30 @@ bool EntryCallTransform::GetEntryPoints(BlockGraph::Block* header_block) {
   return true;
 }
 
+bool EntryCallTransform::IsHotOrCallsHot(
+    const BlockGraph::Block* block) const {
+  DCHECK_NE(static_cast<const RelativeAddressFilter*>(NULL), hot_filter_);
+  DCHECK_NE(static_cast<const BlockGraph::Block*>(NULL), block);
+
+  if (block_graph::IsFiltered(*hot_filter_, block))
+    return true;
+
+  // Any reference to a hot function counts as a call, be it a direct call, a
+  // tail call, or taking its address for an indirect call.
+  BlockGraph::Block::ReferenceMap::const_iterator ref_it =
+      block->references().begin();
+  for (; ref_it != block->references().end(); ++ref_it) {
+    const BlockGraph::Block* referenced = ref_it->second.referenced();
+    if (referenced != block &&
+        referenced->type() == BlockGraph::CODE_BLOCK &&
+        block_graph::IsFiltered(*hot_filter_, referenced)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
 bool EntryCallTransform::PostBlockGraphIteration(
     const TransformPolicyInterface* policy,
     BlockGraph* block_graph,
@@ -14,7 +14,15 @@
 //
 // Declaration of the entry call instrumentation transform. This instruments
 // individual functions by injecting a call to a transformation import at the
-// start of each function.
+// start of each function. Optionally, it also injects a call to an exit hook
+// import right before each return, which spares the profiler from swizzling
+// return addresses to get at function exits.
+//
+// Profiling every function can cost more than the functions themselves, so
+// the set of instrumented functions can be narrowed down to the hot ones and
+// their callers, and small leaf functions can be left alone. Module entry
+// points are always instrumented, as the profiler relies on them to learn
+// about the modules.
 
 #ifndef SYZYGY_INSTRUMENT_TRANSFORMS_ENTRY_CALL_TRANSFORM_H_
 #define SYZYGY_INSTRUMENT_TRANSFORMS_ENTRY_CALL_TRANSFORM_H_
@@ -24,6 +32,7 @@
 
 #include "base/string_piece.h"
 #include "syzygy/block_graph/basic_block.h"
+#include "syzygy/block_graph/filterable.h"
 #include "syzygy/block_graph/iterate.h"
 #include "syzygy/block_graph/transforms/iterative_transform.h"
 #include "syzygy/block_graph/transforms/named_transform.h"
@@ -44,6 +53,21 @@ class EntryCallBasicBlockTransform
       const BlockGraph::Reference& hook_reference,
       bool debug_friendly);
 
+  // Creates a transform that also calls @p exit_hook_reference right before
+  // each return of the function.
+  EntryCallBasicBlockTransform(
+      const BlockGraph::Reference& hook_reference,
+      const BlockGraph::Reference& exit_hook_reference,
+      bool debug_friendly);
+
+  // @name Accessors.
+  // @{
+  size_t min_leaf_instructions() const { return min_leaf_instructions_; }
+  void set_min_leaf_instructions(size_t min_leaf_instructions) {
+    min_leaf_instructions_ = min_leaf_instructions;
+  }
+  // @}
+
   // For NamedBlockGraphTransformImpl.
   static const char kTransformName[];
 
@@ -57,20 +81,36 @@ class EntryCallBasicBlockTransform
   // @}
 
  private:
+  // Inserts a call to the exit hook ahead of each return in
+  // @p basic_block_subgraph.
+  void InsertExitHooks(BasicBlockSubGraph* basic_block_subgraph);
+
+  // @returns true iff @p basic_block_subgraph calls no function and has fewer
+  //     than min_leaf_instructions_ instructions.
+  bool IsSmallLeafFunction(
+      const BasicBlockSubGraph* basic_block_subgraph) const;
+
   // Iff true, assigns the first instruction's source range to
   // the inserted call.
   bool debug_friendly_;
+  // Leaf functions with fewer instructions than this are left alone.
+  size_t min_leaf_instructions_;
   // The hook we call to.
   const BlockGraph::Reference hook_reference_;
+  // The exit hook we call to, if valid.
+  const BlockGraph::Reference exit_hook_reference_;
 
   DISALLOW_COPY_AND_ASSIGN(EntryCallBasicBlockTransform);
 };
 
+// The filter, if any, marks the functions that mustn't be instrumented.
 class EntryCallTransform
     : public block_graph::transforms::IterativeTransformImpl<
-          EntryCallTransform> {
+          EntryCallTransform>,
+      public block_graph::Filterable {
  public:
   typedef block_graph::BlockGraph BlockGraph;
+  typedef block_graph::RelativeAddressFilter RelativeAddressFilter;
   typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
 
   explicit EntryCallTransform(bool debug_friendly);
@@ -78,12 +118,24 @@ class EntryCallTransform
   // @name Accessors.
   // @{
   bool debug_friendly() const { return debug_friendly_; }
+  bool instrument_exits() const { return instrument_exits_; }
+  void set_instrument_exits(bool instrument_exits) {
+    instrument_exits_ = instrument_exits;
+  }
   void set_instrument_dll_name(const base::StringPiece& instrument_dll_name) {
     instrument_dll_name.CopyToString(&instrument_dll_name_);
   }
   const char* instrument_dll_name() const {
     return instrument_dll_name_.c_str();
   }
+  const RelativeAddressFilter* hot_filter() const { return hot_filter_; }
+  void set_hot_filter(const RelativeAddressFilter* hot_filter) {
+    hot_filter_ = hot_filter;
+  }
+  size_t min_leaf_instructions() const { return min_leaf_instructions_; }
+  void set_min_leaf_instructions(size_t min_leaf_instructions) {
+    min_leaf_instructions_ = min_leaf_instructions;
+  }
   // @}
 
   // The name of the import for general entry hooks.
@@ -93,6 +145,17 @@ class EntryCallTransform
   // The name of the import for EXE entry point hook.
   static const char kExeMainEntryHookName[];
 
+  // @{
+  // The names of the imports used in place of the above when exits are
+  // instrumented.
+  static const char kShadowEntryHookName[];
+  static const char kShadowDllMainEntryHookName[];
+  static const char kShadowExeMainEntryHookName[];
+  // @}
+
+  // The name of the import for function exit hooks.
+  static const char kExitHookName[];
+
   // The name of the DLL imported default.
   static const char kDefaultInstrumentDll[];
 
@@ -118,6 +181,10 @@ class EntryCallTransform
 
   bool GetEntryPoints(BlockGraph::Block* header_block);
 
+  // @returns true iff @p block is marked in hot_filter_, or refers to a code
+  //     block that is.
+  bool IsHotOrCallsHot(const BlockGraph::Block* block) const;
+
   // For NamedBlockGraphTransformImpl.
   static const char kTransformName[];
 
@@ -127,10 +194,24 @@ class EntryCallTransform
   BlockGraph::Reference hook_dllmain_ref_;
   BlockGraph::Reference hook_exe_entry_ref_;
 
+  // Reference to the _indirect_pexit import entry. Valid after successful
+  // PreBlockGraphIteration iff instrument_exits_ is true.
+  BlockGraph::Reference hook_exit_ref_;
+
   // Iff true, assigns the first instruction's source range to
   // inserted calls.
   bool debug_friendly_;
 
+  // Iff true, calls the exit hook right before each return.
+  bool instrument_exits_;
+
+  // If not NULL, only the functions marked in this filter and their callers
+  // are instrumented.
+  const RelativeAddressFilter* hot_filter_;
+
+  // Leaf functions with fewer instructions than this are not instrumented.
+  size_t min_leaf_instructions_;
+
   // Name of the instrumentation DLL we import.
   // Defaults to "profile_client.dll".
   std::string instrument_dll_name_;
@@ -16,6 +16,7 @@
 
 #include "syzygy/instrument/transforms/entry_call_transform.h"
 
+#include <set>
 #include <vector>
 
 #include "gmock/gmock.h"
@@ -33,6 +34,12 @@ namespace transforms {
 
 namespace {
 
+using block_graph::RelativeAddressFilter;
+
+// An upper bound on the number of entry points of the test DLL, i.e. DllMain
+// and the TLS callbacks.
+const size_t kMaxEntryPoints = 10;
+
 class TestingEntryCallBasicBlockTransform
     : public EntryCallBasicBlockTransform {
  public:
@@ -47,6 +54,40 @@ class TestingEntryCallBasicBlockTransform
 
 
 class EntryCallTransformTest : public testing::TestDllTransformTest {
+ public:
+  // Runs @p transform on the test DLL.
+  // @returns the number of code blocks of the test DLL that were replaced
+  //     by an instrumented copy.
+  size_t TransformAndCountReplacedCodeBlocks(EntryCallTransform* transform) {
+    std::set<BlockGraph::BlockId> code_block_ids;
+    BlockGraph::BlockMap::const_iterator it = block_graph_.blocks().begin();
+    for (; it != block_graph_.blocks().end(); ++it) {
+      if (it->second.type() == BlockGraph::CODE_BLOCK)
+        code_block_ids.insert(it->first);
+    }
+
+    EXPECT_TRUE(ApplyBlockGraphTransform(
+        transform, &policy_, &block_graph_, dos_header_block_));
+
+    size_t num_replaced = 0;
+    std::set<BlockGraph::BlockId>::const_iterator id_it =
+        code_block_ids.begin();
+    for (; id_it != code_block_ids.end(); ++id_it) {
+      if (block_graph_.GetBlockById(*id_it) == NULL)
+        ++num_replaced;
+    }
+    return num_replaced;
+  }
+
+  // @returns a filter marking the whole test DLL.
+  RelativeAddressFilter WholeImageFilter() {
+    RelativeAddressFilter::Range image_range(
+        core::RelativeAddress(0),
+        pe_file_.nt_headers()->OptionalHeader.SizeOfImage);
+    RelativeAddressFilter filter(image_range);
+    filter.Mark(image_range);
+    return filter;
+  }
 };
 
 class EntryCallBasicBlockTransformTest : public testing::BasicBlockTest {
@@ -60,6 +101,38 @@ class EntryCallBasicBlockTransformTest : public testing::BasicBlockTest {
                               dummy_iat_,
                               103 * sizeof(core::AbsoluteAddress),
                               0);
+    exit_import_ref_ =
+        BlockGraph::Reference(BlockGraph::ABSOLUTE_REF,
+                              sizeof(core::AbsoluteAddress),
+                              dummy_iat_,
+                              104 * sizeof(core::AbsoluteAddress),
+                              0);
+  }
+
+  // Adds a leaf function made of @p num_instructions instructions to the
+  // subgraph.
+  // @returns the description of the function.
+  BasicBlockSubGraph::BlockDescription* AddLeafFunction(
+      size_t num_instructions) {
+    using block_graph::BasicBlockAssembler;
+    using block_graph::BasicCodeBlock;
+
+    BasicCodeBlock* code_block = subgraph_.AddBasicCodeBlock("Leaf()");
+    EXPECT_NE(static_cast<BasicCodeBlock*>(NULL), code_block);
+    code_block->set_offset(0);
+
+    BasicBlockAssembler assm(code_block->instructions().begin(),
+                             &code_block->instructions());
+    for (size_t i = 1; i < num_instructions; ++i)
+      assm.nop(1);
+    assm.ret();
+
+    BasicBlockSubGraph::BlockDescription* desc =
+        subgraph_.AddBlockDescription("Leaf()", "leaf.obj",
+                                      BlockGraph::CODE_BLOCK, 1, 1, 0);
+    EXPECT_NE(static_cast<BasicBlockSubGraph::BlockDescription*>(NULL), desc);
+    desc->basic_block_order.push_back(code_block);
+    return desc;
   }
 
   BlockGraph::Block* TransformAssemblyFunc(bool debug_friendly) {
@@ -79,6 +152,7 @@ class EntryCallBasicBlockTransformTest : public testing::BasicBlockTest {
  protected:
   BlockGraph::Block* dummy_iat_;
   BlockGraph::Reference import_ref_;
+  BlockGraph::Reference exit_import_ref_;
 };
 
 }  // namespace
@@ -87,6 +161,10 @@ TEST_F(EntryCallBasicBlockTransformTest, AccessorsAndMutators) {
   EntryCallBasicBlockTransform tx(import_ref_, false);
 
   EXPECT_STREQ("EntryCallBasicBlockTransform", tx.name());
+  EXPECT_EQ(0U, tx.min_leaf_instructions());
+
+  tx.set_min_leaf_instructions(5);
+  EXPECT_EQ(5U, tx.min_leaf_instructions());
 }
 
 TEST_F(EntryCallBasicBlockTransformTest, ApplyTransform) {
@@ -130,6 +208,63 @@ TEST_F(EntryCallBasicBlockTransformTest, ApplyTransformDebugFriendly) {
   EXPECT_TRUE(created_block->source_ranges().FindRangePair(0, 1) != NULL);
 }
 
+TEST_F(EntryCallBasicBlockTransformTest, ApplyTransformWithExitHooks) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+  ASSERT_NO_FATAL_FAILURE(InitBasicBlockSubGraph());
+
+  EntryCallBasicBlockTransform tx(import_ref_, exit_import_ref_, false);
+
+  block_graph::BlockVector created_blocks;
+  ASSERT_TRUE(ApplyBasicBlockSubGraphTransform(
+      &tx, &policy_, &block_graph_, assembly_func_, &created_blocks));
+  ASSERT_EQ(1U, created_blocks.size());
+  BlockGraph::Block* created_block = created_blocks[0];
+
+  // Every reference to the exit hook belongs to an indirect call that's
+  // immediately followed by a return.
+  size_t num_exit_hooks = 0;
+  BlockGraph::Block::ReferenceMap::const_iterator ref_it =
+      created_block->references().begin();
+  for (; ref_it != created_block->references().end(); ++ref_it) {
+    if (ref_it->second.referenced() != exit_import_ref_.referenced() ||
+        ref_it->second.offset() != exit_import_ref_.offset()) {
+      continue;
+    }
+
+    BlockGraph::Offset offset = ref_it->first;
+    ASSERT_LE(2, offset);
+    ASSERT_GT(created_block->size(), offset + 4U);
+    EXPECT_EQ(0xFF, created_block->data()[offset - 2]);
+    EXPECT_EQ(0x15, created_block->data()[offset - 1]);
+    uint8 next_opcode = created_block->data()[offset + 4];
+    EXPECT_TRUE(next_opcode == 0xC3 || next_opcode == 0xC2);
+    ++num_exit_hooks;
+  }
+  EXPECT_LT(0U, num_exit_hooks);
+}
+
+TEST_F(EntryCallBasicBlockTransformTest, SkipsSmallLeafFunctions) {
+  BasicBlockSubGraph::BlockDescription* desc = AddLeafFunction(3);
+  ASSERT_NE(static_cast<BasicBlockSubGraph::BlockDescription*>(NULL), desc);
+  BasicBlock* leaf = desc->basic_block_order.front();
+
+  TestingEntryCallBasicBlockTransform tx(import_ref_, false);
+  tx.set_min_leaf_instructions(4);
+
+  // The function is left as it is.
+  ASSERT_TRUE(
+      tx.TransformBasicBlockSubGraph(&policy_, &block_graph_, &subgraph_));
+  ASSERT_EQ(1U, desc->basic_block_order.size());
+  EXPECT_EQ(leaf, desc->basic_block_order.front());
+
+  // The function is instrumented once it's large enough.
+  tx.set_min_leaf_instructions(3);
+  ASSERT_TRUE(
+      tx.TransformBasicBlockSubGraph(&policy_, &block_graph_, &subgraph_));
+  EXPECT_EQ(2U, desc->basic_block_order.size());
+  EXPECT_NE(leaf, desc->basic_block_order.front());
+}
+
 TEST_F(EntryCallBasicBlockTransformTest, CorrectlyInstrumentsSelfRecursion) {
   using block_graph::BasicBlockAssembler;
   using block_graph::BasicBlockReference;
@@ -159,7 +294,9 @@ TEST_F(EntryCallBasicBlockTransformTest, CorrectlyInstrumentsSelfRecursion) {
   ASSERT_NE(static_cast<BasicBlockSubGraph::BlockDescription*>(NULL), desc);
   desc->basic_block_order.push_back(code_block);
 
+  // The function isn't a leaf, so its size doesn't matter.
   TestingEntryCallBasicBlockTransform tx(import_ref_, false);
+  tx.set_min_leaf_instructions(100);
 
   // Apply the transform.
   ASSERT_TRUE(
@@ -189,9 +326,23 @@ TEST_F(EntryCallTransformTest, AccessorsAndMutators) {
   EXPECT_STREQ("EntryCallTransform", tx.name());
   EXPECT_STREQ("profile_client.dll", tx.instrument_dll_name());
   EXPECT_EQ(false, tx.debug_friendly());
+  EXPECT_FALSE(tx.instrument_exits());
 
   tx.set_instrument_dll_name("HulaBonga.dll");
   EXPECT_STREQ("HulaBonga.dll", tx.instrument_dll_name());
+
+  tx.set_instrument_exits(true);
+  EXPECT_TRUE(tx.instrument_exits());
+
+  EXPECT_EQ(static_cast<const RelativeAddressFilter*>(NULL),
+            tx.hot_filter());
+  RelativeAddressFilter hot_filter;
+  tx.set_hot_filter(&hot_filter);
+  EXPECT_EQ(&hot_filter, tx.hot_filter());
+
+  EXPECT_EQ(0U, tx.min_leaf_instructions());
+  tx.set_min_leaf_instructions(5);
+  EXPECT_EQ(5U, tx.min_leaf_instructions());
 }
 
 TEST_F(EntryCallTransformTest, TransformCreatesThunkSection) {
@@ -212,5 +363,51 @@ TEST_F(EntryCallTransformTest, TransformCreatesThunkSection) {
             block_graph_.FindSection(common::kThunkSectionName));
 }
 
+TEST_F(EntryCallTransformTest, TransformWithExitHooks) {
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
+
+  EntryCallTransform transform(false);
+  transform.set_instrument_exits(true);
+
+  // Run the transform.
+  ASSERT_TRUE(ApplyBlockGraphTransform(
+      &transform, &policy_, &block_graph_, dos_header_block_));
+}
+
+TEST_F(EntryCallTransformTest, TransformSkipsFilteredFunctions) {
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
+
+  // Only the module entry points are instrumented.
+  RelativeAddressFilter filter(WholeImageFilter());
+  EntryCallTransform transform(false);
+  transform.set_filter(&filter);
+  size_t num_replaced = TransformAndCountReplacedCodeBlocks(&transform);
+  EXPECT_LT(0U, num_replaced);
+  EXPECT_GE(kMaxEntryPoints, num_replaced);
+}
+
+TEST_F(EntryCallTransformTest, TransformWithColdHotFilter) {
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
+
+  // Nothing is hot, so only the module entry points are instrumented.
+  RelativeAddressFilter hot_filter(WholeImageFilter().extent());
+  EntryCallTransform transform(false);
+  transform.set_hot_filter(&hot_filter);
+  size_t num_replaced = TransformAndCountReplacedCodeBlocks(&transform);
+  EXPECT_LT(0U, num_replaced);
+  EXPECT_GE(kMaxEntryPoints, num_replaced);
+}
+
+TEST_F(EntryCallTransformTest, TransformWithHotHotFilter) {
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
+
+  // Everything is hot, so the functions get instrumented.
+  RelativeAddressFilter hot_filter(WholeImageFilter());
+  EntryCallTransform transform(false);
+  transform.set_hot_filter(&hot_filter);
+  size_t num_replaced = TransformAndCountReplacedCodeBlocks(&transform);
+  EXPECT_LT(kMaxEntryPoints, num_replaced);
+}
+
 }  // namespace transforms
 }  // namespace instrument
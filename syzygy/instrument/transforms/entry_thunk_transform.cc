@@ -14,6 +14,8 @@
 
 #include "syzygy/instrument/transforms/entry_thunk_transform.h"
 
+#include <limits>
+
 #include "base/logging.h"
 #include "base/stringprintf.h"
 #include "syzygy/block_graph/block_builder.h"
@@ -35,10 +37,81 @@ using block_graph::BlockGraph;
 using block_graph::Displacement;
 using block_graph::Operand;
 using block_graph::TransformPolicyInterface;
+using block_graph::UntypedReference;
 using pe::transforms::PEAddImportsTransform;
 
 typedef pe::transforms::ImportedModule ImportedModule;
 
+namespace {
+
+// The encodings used to hand-assemble packed thunk tables.
+const uint8 kPushImm32Opcode = 0x68;
+const uint8 kJmpRel8Opcode = 0xEB;
+const uint8 kJmpIndirectOpcode[] = { 0xFF, 0x25 };
+const size_t kPushImm32Size = 5;
+const size_t kJmpRel8Size = 2;
+const size_t kJmpIndirectSize = 6;
+
+// The name of the packed thunk table blocks, and of their tails.
+const char kThunkTableName[] = "EntryThunkTable";
+const char kThunkTableTailName[] = "EntryThunkTableTail";
+
+// @returns the name of a thunk to @p destination.
+std::string GetThunkName(const BlockGraph::Reference& destination) {
+  if (destination.offset() == 0) {
+    return base::StringPrintf("%s%s",
+                              destination.referenced()->name().c_str(),
+                              common::kThunkSuffix);
+  }
+  return base::StringPrintf("%s%s+%d",
+                            destination.referenced()->name().c_str(),
+                            common::kThunkSuffix,
+                            destination.offset());
+}
+
+// Grows @p block and its pending contents @p data by @p size zero bytes.
+// @returns a pointer to the new bytes, valid until @p data next grows.
+uint8* AppendData(BlockGraph::Block* block,
+                  std::vector<uint8>* data,
+                  BlockGraph::Size size) {
+  DCHECK(block != NULL);
+  DCHECK(data != NULL);
+  DCHECK_EQ(block->size(), data->size());
+  data->resize(data->size() + size);
+  block->set_size(data->size());
+  return &data->at(data->size() - size);
+}
+
+// Gives the @p size bytes of @p thunk at @p offset a source range synonymous
+// with @p destination.
+void AddThunkSourceRange(const BlockGraph::Reference& destination,
+                         BlockGraph::Offset offset,
+                         BlockGraph::Size size,
+                         BlockGraph::Block* thunk) {
+  DCHECK(thunk != NULL);
+
+  // This way the debugger will resolve calls and jumps to the thunk to the
+  // destination function's name, which makes the assembly much easier to
+  // read. The downside to this is that the symbols are now no longer unique,
+  // and searching for a function by name may turn up either the function or
+  // the thunk.
+  const BlockGraph::Block::SourceRanges& source_ranges =
+      destination.referenced()->source_ranges();
+  const BlockGraph::Block::SourceRanges::RangePair* source =
+      source_ranges.FindRangePair(destination.offset(), size);
+  if (source == NULL)
+    return;
+
+  // Calculate the offset into the range.
+  size_t offs = destination.offset() - source->first.start();
+  BlockGraph::Block::DataRange data(offset, size);
+  BlockGraph::Block::SourceRange src(source->second.start() + offs, size);
+  bool pushed = thunk->source_ranges().Push(data, src);
+  DCHECK(pushed);
+}
+
+}  // namespace
+
 const char EntryThunkTransform::kTransformName[] =
     "EntryThunkTransform";
 
@@ -54,6 +127,7 @@ EntryThunkTransform::EntryThunkTransform()
     : thunk_section_(NULL),
       instrument_unsafe_references_(true),
       src_ranges_for_thunks_(false),
+      pack_thunks_(false),
       only_instrument_module_entry_(false),
       instrument_dll_name_(kDefaultInstrumentDll) {
 }
@@ -162,6 +236,23 @@ bool EntryThunkTransform::PreBlockGraphIteration(
   return true;
 }
 
+bool EntryThunkTransform::PostBlockGraphIteration(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockGraph::Block* header_block) {
+  // The packed thunk tables are assembled on the side, as growing the blocks'
+  // data one thunk at a time would be quadratic.
+  ThunkTableMap::iterator it = thunk_tables_.begin();
+  for (; it != thunk_tables_.end(); ++it) {
+    ThunkTable& table = it->second;
+    DCHECK_EQ(table.block->size(), table.data.size());
+    table.block->CopyData(table.data.size(), &table.data[0]);
+    table.data.clear();
+  }
+
+  return true;
+}
+
 bool EntryThunkTransform::OnBlock(const TransformPolicyInterface* policy,
                                   BlockGraph* block_graph,
                                   BlockGraph::Block* block) {
@@ -277,25 +368,32 @@ bool EntryThunkTransform::InstrumentCodeBlockReferrer(
 
   // Look for the reference in the thunk block map, and only create a new one
   // if it does not already exist.
-  BlockGraph::Block* thunk_block = NULL;
+  ThunkLocation thunk(NULL, 0);
   ThunkBlockMap::const_iterator thunk_it = thunk_block_map->find(ref.offset());
-  if (thunk_it == thunk_block_map->end()) {
-    thunk_block = CreateOneThunk(block_graph, ref, *hook_ref, param);
-    if (thunk_block == NULL) {
-      LOG(ERROR) << "Unable to create thunk block.";
+  if (thunk_it != thunk_block_map->end()) {
+    thunk = thunk_it->second;
+  } else if (pack_thunks_) {
+    if (!AddPackedThunk(block_graph, ref, *hook_ref, param, &thunk)) {
+      LOG(ERROR) << "Unable to add packed thunk.";
       return false;
     }
-    (*thunk_block_map)[ref.offset()] = thunk_block;
+    (*thunk_block_map)[ref.offset()] = thunk;
   } else {
-    thunk_block = thunk_it->second;
+    thunk.first = CreateOneThunk(block_graph, ref, *hook_ref, param);
+    if (thunk.first == NULL) {
+      LOG(ERROR) << "Unable to create thunk block.";
+      return false;
+    }
+    (*thunk_block_map)[ref.offset()] = thunk;
   }
-  DCHECK(thunk_block != NULL);
+  DCHECK(thunk.first != NULL);
 
   // Update the referrer to point to the thunk.
   BlockGraph::Reference new_ref(ref.type(),
                                 ref.size(),
-                                thunk_block,
-                                0, 0);
+                                thunk.first,
+                                thunk.second,
+                                thunk.second);
   referrer.first->SetReference(referrer.second, new_ref);
 
   return true;
@@ -306,17 +404,7 @@ BlockGraph::Block* EntryThunkTransform::CreateOneThunk(
     const BlockGraph::Reference& destination,
     const BlockGraph::Reference& hook,
     const Immediate* parameter) {
-  std::string name;
-  if (destination.offset() == 0) {
-    name = base::StringPrintf("%s%s",
-                              destination.referenced()->name().c_str(),
-                              common::kThunkSuffix);
-  } else {
-    name = base::StringPrintf("%s%s+%d",
-                              destination.referenced()->name().c_str(),
-                              common::kThunkSuffix,
-                              destination.offset());
-  }
+  std::string name(GetThunkName(destination));
 
   // Set up a basic block subgraph containing a single block description, with
   // that block description containing a single empty basic block, and get an
@@ -356,29 +444,108 @@ BlockGraph::Block* EntryThunkTransform::CreateOneThunk(
   DCHECK_EQ(1u, block_builder.new_blocks().size());
   BlockGraph::Block* thunk = block_builder.new_blocks().front();
 
-  if (src_ranges_for_thunks_) {
-    // Give the thunk a source range synonymous with the destination.
-    // That way the debugger will resolve calls and jumps to the thunk to the
-    // destination function's name, which makes the assembly much easier to
-    // read. The downside to this is that the symbols are now no longer unique,
-    // and searching for a function by name may turn up either the function or
-    // the thunk.
-    const BlockGraph::Block::SourceRanges& source_ranges =
-        destination.referenced()->source_ranges();
-    const BlockGraph::Block::SourceRanges::RangePair* source =
-        source_ranges.FindRangePair(destination.offset(), thunk->size());
-    if (source != NULL) {
-      // Calculate the offset into the range.
-      size_t offs = destination.offset() - source->first.start();
-      BlockGraph::Block::DataRange data(0, thunk->size());
-      BlockGraph::Block::SourceRange src(source->second.start() + offs,
-                                          thunk->size());
-      bool pushed = thunk->source_ranges().Push(data, src);
-      DCHECK(pushed);
+  // Give the thunk a source range synonymous with the destination.
+  if (src_ranges_for_thunks_)
+    AddThunkSourceRange(destination, 0, thunk->size(), thunk);
+
+  return thunk;
+}
+
+bool EntryThunkTransform::AddPackedThunk(
+    BlockGraph* block_graph,
+    const BlockGraph::Reference& destination,
+    const BlockGraph::Reference& hook,
+    const Immediate* parameter,
+    ThunkLocation* location) {
+  DCHECK(block_graph != NULL);
+  DCHECK(location != NULL);
+  DCHECK(thunk_section_ != NULL);
+
+  BlockGraph::Size thunk_size = kPushImm32Size + kJmpRel8Size;
+  if (parameter != NULL)
+    thunk_size += kPushImm32Size;
+
+  ThunkTable& table = thunk_tables_[ThunkTableKey(&hook, parameter)];
+  if (table.block == NULL) {
+    table.block = block_graph->AddBlock(BlockGraph::CODE_BLOCK, 0,
+                                        kThunkTableName);
+    if (table.block == NULL) {
+      LOG(ERROR) << "Unable to create thunk table block.";
+      return false;
+    }
+    table.block->set_section(thunk_section_->id());
+  }
+  BlockGraph::Block* block = table.block;
+
+  // Emit a new tail if there is none yet, or if the current one is out of
+  // reach of a short jump from the end of the new thunk.
+  BlockGraph::Offset thunk_end = block->size() + thunk_size;
+  if (table.tail_offset < 0 ||
+      table.tail_offset - thunk_end < std::numeric_limits<int8>::min()) {
+    table.tail_offset = block->size();
+    uint8* data = AppendData(block, &table.data, kJmpIndirectSize);
+    data[0] = kJmpIndirectOpcode[0];
+    data[1] = kJmpIndirectOpcode[1];
+    block->SetReference(table.tail_offset + sizeof(kJmpIndirectOpcode),
+                        BlockGraph::Reference(BlockGraph::ABSOLUTE_REF,
+                                              sizeof(core::AbsoluteAddress),
+                                              hook.referenced(),
+                                              hook.offset(),
+                                              hook.offset()));
+    block->SetLabel(table.tail_offset, kThunkTableTailName,
+                    BlockGraph::CODE_LABEL);
+    thunk_end += kJmpIndirectSize;
+  }
+
+  BlockGraph::Offset offset = block->size();
+  location->first = block;
+  location->second = offset;
+  uint8* data = AppendData(block, &table.data, thunk_size);
+
+  // Set up our thunk:
+  // 1. push parameter
+  // 2. push func_addr
+  // 3. jmp tail
+  if (parameter != NULL) {
+    DCHECK_EQ(core::kSize32Bit, parameter->size());
+    *data = kPushImm32Opcode;
+    const UntypedReference& param_ref = parameter->reference();
+    if (param_ref.IsValid()) {
+      DCHECK_EQ(BasicBlockReference::REFERRED_TYPE_BLOCK,
+                param_ref.referred_type());
+      block->SetReference(offset + 1,
+                          BlockGraph::Reference(BlockGraph::ABSOLUTE_REF,
+                                                sizeof(core::AbsoluteAddress),
+                                                param_ref.block(),
+                                                param_ref.offset(),
+                                                param_ref.base()));
+    } else {
+      *reinterpret_cast<uint32*>(data + 1) = parameter->value();
     }
+    data += kPushImm32Size;
+    offset += kPushImm32Size;
   }
 
-  return thunk;
+  *data = kPushImm32Opcode;
+  block->SetReference(offset + 1,
+                      BlockGraph::Reference(BlockGraph::ABSOLUTE_REF,
+                                            sizeof(core::AbsoluteAddress),
+                                            destination.referenced(),
+                                            destination.offset(),
+                                            destination.offset()));
+  data += kPushImm32Size;
+
+  data[0] = kJmpRel8Opcode;
+  data[1] = static_cast<uint8>(table.tail_offset - thunk_end);
+
+  block->SetLabel(location->second, GetThunkName(destination),
+                  BlockGraph::CODE_LABEL);
+
+  // Give the thunk a source range synonymous with the destination.
+  if (src_ranges_for_thunks_)
+    AddThunkSourceRange(destination, location->second, thunk_size, block);
+
+  return true;
 }
 
 bool EntryThunkTransform::GetEntryPoints(BlockGraph::Block* header_block) {
@@ -43,12 +43,30 @@
 //
 // Prior to executing the thunk the stack is set up as if the call was going to
 // be directly to the original function.
+//
+// By default each thunk is a block of its own. When thunks are packed they are
+// instead appended, in the order the functions are instrumented, to a table
+// block per hook and parameter. Consecutive thunks in a table share a tail
+// that jumps to the hook, and reach it with a short jump:
+//
+//   0xff 0x25 0x88 0x77 0x66 0x55  jmp [0x55667788]  ; the shared tail.
+//   0x68 0x44 0x33 0x22 0x11       push 0x11223344
+//   0xeb 0xf3                      jmp tail
+//   0x68 0x48 0x33 0x22 0x11       push 0x11223348
+//   0xeb 0xec                      jmp tail
+//   ...
+//
+// A new tail is emitted whenever the previous one is out of reach of a short
+// jump. This shrinks an unparameterized thunk from 11 to a little over 7
+// bytes, and keeps the thunks of neighbouring functions next to each other.
 
 #ifndef SYZYGY_INSTRUMENT_TRANSFORMS_ENTRY_THUNK_TRANSFORM_H_
 #define SYZYGY_INSTRUMENT_TRANSFORMS_ENTRY_THUNK_TRANSFORM_H_
 
+#include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "base/string_piece.h"
 #include "syzygy/block_graph/basic_block_assembler.h"
@@ -85,6 +103,13 @@ class EntryThunkTransform
     return src_ranges_for_thunks_;
   }
 
+  void set_pack_thunks(bool pack_thunks) {
+    pack_thunks_ = pack_thunks;
+  }
+  bool pack_thunks() const {
+    return pack_thunks_;
+  }
+
   void set_only_instrument_module_entry(bool only_instrument_module_entry) {
     only_instrument_module_entry_ = only_instrument_module_entry;
   }
@@ -137,7 +162,10 @@ class EntryThunkTransform
   static const char kDefaultInstrumentDll[];
 
  protected:
-  typedef std::map<BlockGraph::Offset, BlockGraph::Block*> ThunkBlockMap;
+  // The location of a thunk: the block containing it and its offset in that
+  // block. Unpacked thunks are always at offset zero in their own block.
+  typedef std::pair<BlockGraph::Block*, BlockGraph::Offset> ThunkLocation;
+  typedef std::map<BlockGraph::Offset, ThunkLocation> ThunkBlockMap;
 
   // @name IterativeTransformImpl implementation.
   // @{
@@ -147,6 +175,9 @@ class EntryThunkTransform
   bool OnBlock(const TransformPolicyInterface* policy,
                BlockGraph* block_graph,
                BlockGraph::Block* block);
+  bool PostBlockGraphIteration(const TransformPolicyInterface* policy,
+                               BlockGraph* block_graph,
+                               BlockGraph::Block* header_block);
   // @}
 
   // Instrument a single block.
@@ -169,6 +200,22 @@ class EntryThunkTransform
                                     const BlockGraph::Reference& hook,
                                     const Immediate* parameter);
 
+  // Appends a single thunk to destination to the packed thunk table for the
+  // given hook and parameter, creating the table as necessary.
+  // @param block_graph the block-graph being instrumented.
+  // @param destination the destination reference.
+  // @param hook a reference to the hook to use. This must be one of the hook
+  //     references owned by this transform.
+  // @param parameter the parameter to be passed to the thunk. If this is NULL
+  //     then an unparameterized thunk will be created.
+  // @param location receives the location of the new thunk.
+  // @returns true on success, false otherwise.
+  bool AddPackedThunk(BlockGraph* block_graph,
+                      const BlockGraph::Reference& destination,
+                      const BlockGraph::Reference& hook,
+                      const Immediate* parameter,
+                      ThunkLocation* location);
+
  private:
   friend IterativeTransformImpl<EntryThunkTransform>;
   friend NamedBlockGraphTransformImpl<EntryThunkTransform>;
@@ -178,10 +225,28 @@ class EntryThunkTransform
   // For NamedBlockGraphTransformImpl.
   static const char kTransformName[];
 
+  // A packed thunk table, the offset of the tail its most recently added
+  // thunks jump to, and its contents until they are copied to the block in
+  // PostBlockGraphIteration. The tail offset is -1 until the first tail is
+  // emitted.
+  struct ThunkTable {
+    ThunkTable() : block(NULL), tail_offset(-1) {}
+    BlockGraph::Block* block;
+    BlockGraph::Offset tail_offset;
+    std::vector<uint8> data;
+  };
+  // The packed thunk tables, keyed by the hook and parameter they use.
+  typedef std::pair<const BlockGraph::Reference*, const Immediate*>
+      ThunkTableKey;
+  typedef std::map<ThunkTableKey, ThunkTable> ThunkTableMap;
+
   // The section we put our thunks in. Valid after successful
   // PreBlockGraphIteration.
   BlockGraph::Section* thunk_section_;
 
+  // The packed thunk tables created so far.
+  ThunkTableMap thunk_tables_;
+
   // References to _indirect_penter and _indirect_penter_dllmain import
   // entries. Valid after successful PreBlockGraphIteration.
   BlockGraph::Reference hook_ref_;
@@ -197,6 +262,10 @@ class EntryThunkTransform
   // friendly, at the cost of the uniqueness of address->name resolution.
   bool src_ranges_for_thunks_;
 
+  // Iff true, thunks are packed into tables sharing their tails rather than
+  // each being created in a block of their own.
+  bool pack_thunks_;
+
   // If true, only instrument DLL entry points.
   bool only_instrument_module_entry_;
 
@@ -18,6 +18,7 @@
 
 #include <vector>
 
+#include "base/stringprintf.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/block_graph/typed_block.h"
@@ -56,8 +57,17 @@ struct ParamThunk {
   WORD indirect_jmp;
   DWORD hook_addr;  // The instrumentation hook that gets called indirectly.
 };
+struct PackedThunk {
+  BYTE push;
+  DWORD func_addr;  // The real function to invoke.
+  BYTE short_jmp;
+  BYTE jmp_displacement;  // The displacement to the table's tail.
+};
 #pragma pack(pop)
 
+// The size of the tail shared by packed thunks.
+const size_t kPackedThunkTailSize = 6;
+
 class EntryThunkTransformTest : public testing::Test {
  public:
   EntryThunkTransformTest()
@@ -197,6 +207,58 @@ class EntryThunkTransformTest : public testing::Test {
     }
   }
 
+  // Retrieves the blocks in the thunk section.
+  void FindThunkSectionBlocks(ConstBlockVector* ret) {
+    ASSERT_TRUE(ret != NULL);
+    EXPECT_TRUE(ret->empty());
+
+    BlockGraph::Section* thunk_section =
+        bg_.FindSection(common::kThunkSectionName);
+    ASSERT_TRUE(thunk_section != NULL);
+
+    BlockGraph::BlockMap::const_iterator it = bg_.blocks().begin();
+    for (; it != bg_.blocks().end(); ++it) {
+      if (it->second.section() == thunk_section->id())
+        ret->push_back(&it->second);
+    }
+  }
+
+  // Verifies that @p ref refers to a packed thunk to @p destination at
+  // @p destination_offset, and that the thunk jumps to a tail that jumps to
+  // a hook.
+  void VerifyPackedThunk(const BlockGraph::Reference& ref,
+                         BlockGraph::Block* destination,
+                         BlockGraph::Offset destination_offset) {
+    const BlockGraph::Block* table = ref.referenced();
+    ASSERT_TRUE(table != NULL);
+    ASSERT_EQ(BlockGraph::CODE_BLOCK, table->type());
+    ASSERT_LE(ref.offset() + sizeof(PackedThunk), table->data_size());
+
+    const PackedThunk* thunk =
+        reinterpret_cast<const PackedThunk*>(table->data() + ref.offset());
+    EXPECT_EQ(0x68, thunk->push);
+    EXPECT_EQ(0xEB, thunk->short_jmp);
+
+    BlockGraph::Reference func_ref;
+    ASSERT_TRUE(table->GetReference(
+        ref.offset() + offsetof(PackedThunk, func_addr), &func_ref));
+    EXPECT_EQ(BlockGraph::ABSOLUTE_REF, func_ref.type());
+    EXPECT_EQ(destination, func_ref.referenced());
+    EXPECT_EQ(destination_offset, func_ref.offset());
+
+    // The short jump must land on a tail.
+    BlockGraph::Offset tail = ref.offset() + sizeof(PackedThunk) +
+        static_cast<int8>(thunk->jmp_displacement);
+    ASSERT_LE(0, tail);
+    ASSERT_LE(tail + kPackedThunkTailSize, table->data_size());
+    EXPECT_EQ(0xFF, table->data()[tail]);
+    EXPECT_EQ(0x25, table->data()[tail + 1]);
+
+    BlockGraph::Reference hook_ref;
+    ASSERT_TRUE(table->GetReference(tail + 2, &hook_ref));
+    EXPECT_EQ(BlockGraph::ABSOLUTE_REF, hook_ref.type());
+  }
+
   size_t CountDestinations(const ConstBlockVector& blocks) {
     typedef std::set<std::pair<BlockGraph::Block*, BlockGraph::Offset>>
         ReferenceMap;
@@ -382,14 +444,17 @@ TEST_F(EntryThunkTransformTest, AccessorsAndMutators) {
   EXPECT_TRUE(tx.instrument_unsafe_references());
   EXPECT_FALSE(tx.src_ranges_for_thunks());
   EXPECT_FALSE(tx.only_instrument_module_entry());
+  EXPECT_FALSE(tx.pack_thunks());
 
   tx.set_instrument_unsafe_references(false);
   tx.set_src_ranges_for_thunks(true);
   tx.set_only_instrument_module_entry(true);
+  tx.set_pack_thunks(true);
 
   EXPECT_FALSE(tx.instrument_unsafe_references());
   EXPECT_TRUE(tx.src_ranges_for_thunks());
   EXPECT_TRUE(tx.only_instrument_module_entry());
+  EXPECT_TRUE(tx.pack_thunks());
 }
 
 TEST_F(EntryThunkTransformTest, ParameterizedThunks) {
@@ -462,6 +527,81 @@ TEST_F(EntryThunkTransformTest, InstrumentAllWithParam) {
   EXPECT_EQ(num_sections_pre_transform_ + 1, bg_.sections().size());
 }
 
+TEST_F(EntryThunkTransformTest, InstrumentAllPacked) {
+  EntryThunkTransform transform;
+  ASSERT_NO_FATAL_FAILURE(SetEmptyDllEntryPoint());
+  transform.set_pack_thunks(true);
+
+  ASSERT_TRUE(ApplyBlockGraphTransform(
+      &transform, &policy_, &bg_, dos_header_block_));
+
+  // The three thunks should share a single table and tail.
+  ConstBlockVector tables;
+  ASSERT_NO_FATAL_FAILURE(FindThunkSectionBlocks(&tables));
+  ASSERT_EQ(1u, tables.size());
+  EXPECT_EQ(kPackedThunkTailSize + 3 * sizeof(PackedThunk),
+            tables[0]->size());
+  EXPECT_EQ(4u, tables[0]->labels().size());
+
+  // All references to the functions should go through the thunks.
+  BlockGraph::Reference ref;
+  ASSERT_TRUE(array_->GetReference(0, &ref));
+  ASSERT_NO_FATAL_FAILURE(VerifyPackedThunk(ref, foo_, 0));
+  ASSERT_TRUE(array_->GetReference(4, &ref));
+  ASSERT_NO_FATAL_FAILURE(VerifyPackedThunk(ref, bar_, 0));
+  ASSERT_TRUE(array_->GetReference(8, &ref));
+  ASSERT_NO_FATAL_FAILURE(VerifyPackedThunk(ref, foo_, 5));
+  ASSERT_TRUE(foo_->GetReference(5, &ref));
+  ASSERT_NO_FATAL_FAILURE(VerifyPackedThunk(ref, bar_, 0));
+  ASSERT_TRUE(bar_->GetReference(5, &ref));
+  ASSERT_NO_FATAL_FAILURE(VerifyPackedThunk(ref, foo_, 5));
+}
+
+TEST_F(EntryThunkTransformTest, InstrumentManyPacked) {
+  // Add enough functions that the thunks can't all reach a single tail.
+  const size_t kNumFunctions = 20;
+  BlockGraph::Section* text = bg_.FindSection(pe::kCodeSectionName);
+  ASSERT_TRUE(text != NULL);
+  std::vector<BlockGraph::Block*> functions;
+  for (size_t i = 0; i < kNumFunctions; ++i) {
+    std::string name(base::StringPrintf("f%d", static_cast<int>(i)));
+    BlockGraph::Block* function =
+        bg_.AddBlock(BlockGraph::CODE_BLOCK, 20, name);
+    function->set_section(text->id());
+    BlockGraph::Offset offset = (3 + i) * sizeof(AbsoluteAddress);
+    ASSERT_TRUE(array_->SetReference(offset,
+        BlockGraph::Reference(BlockGraph::ABSOLUTE_REF,
+                              sizeof(AbsoluteAddress),
+                              function,
+                              0, 0)));
+    functions.push_back(function);
+  }
+
+  EntryThunkTransform transform;
+  ASSERT_NO_FATAL_FAILURE(SetEmptyDllEntryPoint());
+  transform.set_pack_thunks(true);
+
+  ASSERT_TRUE(ApplyBlockGraphTransform(
+      &transform, &policy_, &bg_, dos_header_block_));
+
+  // At most 17 thunks reach a tail, so the 23 thunks need two of them.
+  ConstBlockVector tables;
+  ASSERT_NO_FATAL_FAILURE(FindThunkSectionBlocks(&tables));
+  ASSERT_EQ(1u, tables.size());
+  EXPECT_EQ(2 * kPackedThunkTailSize + 23 * sizeof(PackedThunk),
+            tables[0]->size());
+
+  // The thunks are laid out in the order of the functions.
+  BlockGraph::Offset previous_offset = 0;
+  for (size_t i = 0; i < kNumFunctions; ++i) {
+    BlockGraph::Reference ref;
+    ASSERT_TRUE(array_->GetReference((3 + i) * sizeof(AbsoluteAddress), &ref));
+    ASSERT_NO_FATAL_FAILURE(VerifyPackedThunk(ref, functions[i], 0));
+    EXPECT_LT(previous_offset, ref.offset());
+    previous_offset = ref.offset();
+  }
+}
+
 TEST_F(EntryThunkTransformTest, InstrumentModuleEntriesOnlyNone) {
   EntryThunkTransform transform;
   ASSERT_NO_FATAL_FAILURE(SetEmptyDllEntryPoint());
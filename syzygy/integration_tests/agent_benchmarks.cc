@@ -0,0 +1,287 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Measures the cost per call of the hot paths of the agents: the profiler's
+// function entry hook, with return thunks or with a shadow stack, the
+// basic-block entry counters and the ASan checks.
+// The test DLL is instrumented with each agent in turn, and its hot loop is
+// run concurrently on a varying number of threads, all of them hitting the
+// same blocks. The results are reported as perf-dashboard RESULT lines, and
+// an upper bound can be enforced with --max-cycles-per-call to catch
+// regressions on the bots.
+
+#include <intrin.h>
+#include <windows.h>  // NOLINT
+
+#include <vector>
+
+#include "base/command_line.h"
+#include "base/string_number_conversions.h"
+#include "base/files/file_path.h"
+#include "base/win/scoped_handle.h"
+#include "gtest/gtest.h"
+#include "syzygy/common/application.h"
+#include "syzygy/common/unittest_util.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/instrument/instrument_app.h"
+#include "syzygy/integration_tests/benchmark_tests.h"
+#include "syzygy/integration_tests/integration_tests_dll.h"
+#include "syzygy/pe/unittest_util.h"
+#include "syzygy/trace/common/unittest_util.h"
+
+namespace integration_tests {
+
+namespace {
+
+typedef unsigned int (CALLBACK* EndToEndTestFunc)(unsigned int);
+
+// The switch used to specify the maximum acceptable cost per call.
+const char kMaxCyclesPerCallSwitch[] = "max-cycles-per-call";
+
+// The numbers of threads the hot loop is run on concurrently.
+const size_t kThreadCounts[] = { 1, 2, 4, 8 };
+
+// The state of a thread running the hot loop.
+struct BenchmarkThread {
+  BenchmarkThread()
+      : func(NULL), ready_event(NULL), start_event(NULL), cycles(0) {
+  }
+
+  // The entry point of the test DLL.
+  EndToEndTestFunc func;
+  // Signaled by the thread once it has warmed up.
+  HANDLE ready_event;
+  // Signaled by the benchmark to start all of the threads at once.
+  HANDLE start_event;
+  // Receives the number of cycles spent in the hot loop.
+  uint64 cycles;
+};
+
+DWORD WINAPI RunBenchmarkThread(void* param) {
+  BenchmarkThread* thread = reinterpret_cast<BenchmarkThread*>(param);
+
+  // Run the loop once beforehand, so that the agents set up their per-thread
+  // state outside of the measurement.
+  thread->func(testing::kBenchmarkHotPath);
+  ::SetEvent(thread->ready_event);
+
+  ::WaitForSingleObject(thread->start_event, INFINITE);
+  uint64 start = __rdtsc();
+  thread->func(testing::kBenchmarkHotPath);
+  thread->cycles = __rdtsc() - start;
+
+  return 0;
+}
+
+class AgentBenchmark : public testing::PELibUnitTest {
+ public:
+  typedef testing::PELibUnitTest Super;
+
+  AgentBenchmark()
+      : cmd_line_(base::FilePath(L"instrument.exe")),
+        max_cycles_per_call_(0) {
+  }
+
+  void SetUp() {
+    Super::SetUp();
+
+    // Keep the instrumentation messages out of the benchmark output.
+    logging::SetMinLogLevel(logging::LOG_FATAL);
+
+    CreateTemporaryDir(&temp_dir_);
+    stdin_path_ = temp_dir_.Append(L"NUL");
+    stdout_path_ = temp_dir_.Append(L"stdout.txt");
+    stderr_path_ = temp_dir_.Append(L"stderr.txt");
+    InitStreams(stdin_path_, stdout_path_, stderr_path_);
+
+    input_dll_path_ =
+        testing::GetExeRelativePath(L"integration_tests_dll.dll");
+    output_dll_path_ = temp_dir_.Append(input_dll_path_.BaseName());
+    traces_dir_ = temp_dir_.Append(L"traces");
+    service_.SetEnvironment();
+
+    const CommandLine* cmd_line = CommandLine::ForCurrentProcess();
+    if (cmd_line->HasSwitch(kMaxCyclesPerCallSwitch)) {
+      ASSERT_TRUE(base::StringToSizeT(
+          cmd_line->GetSwitchValueASCII(kMaxCyclesPerCallSwitch),
+          &max_cycles_per_call_));
+    }
+  }
+
+  void TearDown() {
+    // The module handle has to be released before Super::TearDown, otherwise
+    // the instrumented DLL cannot be deleted.
+    module_.Release();
+
+    Super::TearDown();
+  }
+
+  // Loads the test DLL as is, to get a baseline.
+  void LoadOriginalTestDll() {
+    ASSERT_NO_FATAL_FAILURE(LoadTestDll(input_dll_path_, &module_));
+  }
+
+  // Instruments the test DLL in the given mode and loads it.
+  // @param mode The instrumentation mode.
+  void InstrumentAndLoadTestDll(const std::string& mode) {
+    cmd_line_.AppendSwitchPath("input-image", input_dll_path_);
+    cmd_line_.AppendSwitchPath("output-image", output_dll_path_);
+    cmd_line_.AppendSwitchASCII("mode", mode);
+
+    common::Application<instrument::InstrumentApp> app;
+    app.set_command_line(&cmd_line_);
+    app.set_in(in());
+    app.set_out(out());
+    app.set_err(err());
+    ASSERT_EQ(0, app.Run());
+
+    ASSERT_NO_FATAL_FAILURE(LoadTestDll(output_dll_path_, &module_));
+  }
+
+  // Runs the hot loop of the loaded test DLL concurrently on @p thread_count
+  // threads.
+  // @param thread_count The number of threads to use.
+  // @param cycles_per_call Receives the mean number of cycles per iteration
+  //     of the hot loop.
+  void MeasureCyclesPerCall(size_t thread_count, double* cycles_per_call) {
+    ASSERT_TRUE(cycles_per_call != NULL);
+
+    EndToEndTestFunc func = reinterpret_cast<EndToEndTestFunc>(
+        ::GetProcAddress(module_, "EndToEndTest"));
+    ASSERT_TRUE(func != NULL);
+
+    base::win::ScopedHandle start_event(
+        ::CreateEvent(NULL, TRUE, FALSE, NULL));
+    ASSERT_TRUE(start_event.IsValid());
+
+    std::vector<BenchmarkThread> threads(thread_count);
+    std::vector<HANDLE> ready_events;
+    std::vector<HANDLE> thread_handles;
+    for (size_t i = 0; i < thread_count; ++i) {
+      threads[i].func = func;
+      threads[i].start_event = start_event.Get();
+      threads[i].ready_event = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+      ASSERT_TRUE(threads[i].ready_event != NULL);
+      ready_events.push_back(threads[i].ready_event);
+    }
+
+    for (size_t i = 0; i < thread_count; ++i) {
+      HANDLE handle = ::CreateThread(NULL, 0, &RunBenchmarkThread,
+                                     &threads[i], 0, NULL);
+      ASSERT_TRUE(handle != NULL);
+      thread_handles.push_back(handle);
+    }
+
+    // Start all of the threads at once, once they have all warmed up.
+    ::WaitForMultipleObjects(ready_events.size(), &ready_events[0], TRUE,
+                             INFINITE);
+    ::SetEvent(start_event);
+    ::WaitForMultipleObjects(thread_handles.size(), &thread_handles[0], TRUE,
+                             INFINITE);
+
+    uint64 total_cycles = 0;
+    for (size_t i = 0; i < thread_count; ++i) {
+      ::CloseHandle(thread_handles[i]);
+      ::CloseHandle(ready_events[i]);
+      total_cycles += threads[i].cycles;
+    }
+
+    *cycles_per_call = static_cast<double>(total_cycles) /
+        (thread_count * testing::kBenchmarkIterations);
+  }
+
+  // Measures the loaded test DLL across all of the thread counts, and reports
+  // the results.
+  // @param agent The name of the agent the test DLL is instrumented with.
+  void RunBenchmark(const char* agent) {
+    for (size_t i = 0; i < arraysize(kThreadCounts); ++i) {
+      double cycles_per_call = 0;
+      ASSERT_NO_FATAL_FAILURE(
+          MeasureCyclesPerCall(kThreadCounts[i], &cycles_per_call));
+
+      // This is the format understood by the perf dashboards.
+      ::printf("RESULT agent_cycles_per_call: %s_%d_threads= %.2f cycles\n",
+               agent, kThreadCounts[i], cycles_per_call);
+
+      if (max_cycles_per_call_ != 0) {
+        EXPECT_LE(cycles_per_call, static_cast<double>(max_cycles_per_call_))
+            << agent << " with " << kThreadCounts[i] << " threads.";
+      }
+    }
+  }
+
+  // Stashes the current log-level before each test instance and restores it
+  // after each test completes.
+  testing::ScopedLogLevelSaver log_level_saver;
+
+  // @name Command-line, parameters and outputs.
+  // @{
+  CommandLine cmd_line_;
+  base::FilePath temp_dir_;
+  base::FilePath stdin_path_;
+  base::FilePath stdout_path_;
+  base::FilePath stderr_path_;
+  base::FilePath input_dll_path_;
+  base::FilePath output_dll_path_;
+  base::FilePath traces_dir_;
+  // @}
+
+  // The maximum acceptable cost per call, or zero for no limit.
+  size_t max_cycles_per_call_;
+
+  // The test_dll module.
+  testing::ScopedHMODULE module_;
+
+  // Our call trace service process instance.
+  testing::CallTraceService service_;
+};
+
+}  // namespace
+
+TEST_F(AgentBenchmark, Uninstrumented) {
+  ASSERT_NO_FATAL_FAILURE(LoadOriginalTestDll());
+  ASSERT_NO_FATAL_FAILURE(RunBenchmark("none"));
+}
+
+TEST_F(AgentBenchmark, Asan) {
+  ASSERT_NO_FATAL_FAILURE(InstrumentAndLoadTestDll("asan"));
+  ASSERT_NO_FATAL_FAILURE(RunBenchmark("asan"));
+}
+
+TEST_F(AgentBenchmark, BBEntry) {
+  ASSERT_NO_FATAL_FAILURE(service_.Start(traces_dir_));
+  ASSERT_NO_FATAL_FAILURE(InstrumentAndLoadTestDll("bbentry"));
+  ASSERT_NO_FATAL_FAILURE(RunBenchmark("bbentry"));
+  module_.Reset(NULL);
+  ASSERT_NO_FATAL_FAILURE(service_.Stop());
+}
+
+TEST_F(AgentBenchmark, Profile) {
+  ASSERT_NO_FATAL_FAILURE(service_.Start(traces_dir_));
+  ASSERT_NO_FATAL_FAILURE(InstrumentAndLoadTestDll("profile"));
+  ASSERT_NO_FATAL_FAILURE(RunBenchmark("profile"));
+  module_.Reset(NULL);
+  ASSERT_NO_FATAL_FAILURE(service_.Stop());
+}
+
+TEST_F(AgentBenchmark, ProfileShadowStack) {
+  ASSERT_NO_FATAL_FAILURE(service_.Start(traces_dir_));
+  cmd_line_.AppendSwitch("shadow-stack");
+  ASSERT_NO_FATAL_FAILURE(InstrumentAndLoadTestDll("profile"));
+  ASSERT_NO_FATAL_FAILURE(RunBenchmark("profile_shadow_stack"));
+  module_.Reset(NULL);
+  ASSERT_NO_FATAL_FAILURE(service_.Stop());
+}
+
+}  // namespace integration_tests
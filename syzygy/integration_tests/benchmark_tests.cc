@@ -0,0 +1,44 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/integration_tests/benchmark_tests.h"
+
+namespace testing {
+
+namespace {
+
+// The function called in the hot loop. It must stay out of line, so that
+// every iteration goes through the function entry hooks.
+__declspec(noinline) unsigned int BenchmarkHotFunction(unsigned int* value) {
+  if ((*value & 1) != 0)
+    return ++*value;
+  *value += 3;
+  return *value;
+}
+
+}  // namespace
+
+unsigned int BenchmarkHotPath() {
+  // The value lives on the heap so that its accesses get checked by the ASan
+  // instrumentation, and is private to the thread so that the benchmark
+  // measures the contention in the agents rather than on the value itself.
+  unsigned int* value = new unsigned int(0);
+  unsigned int result = 0;
+  for (unsigned int i = 0; i < kBenchmarkIterations; ++i)
+    result += BenchmarkHotFunction(value);
+  delete value;
+  return result;
+}
+
+}  // namespace testing
@@ -0,0 +1,35 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the functions used to benchmark the hot paths of the agents.
+#ifndef SYZYGY_INTEGRATION_TESTS_BENCHMARK_TESTS_H_
+#define SYZYGY_INTEGRATION_TESTS_BENCHMARK_TESTS_H_
+
+namespace testing {
+
+// The number of iterations of the hot loop performed by BenchmarkHotPath.
+const unsigned int kBenchmarkIterations = 100000;
+
+// Calls a small function kBenchmarkIterations times. Each iteration goes
+// through a function entry, a handful of basic blocks and a few heap
+// accesses, which exercises the hooks of the profiler, basic-block entry and
+// ASan agents. When called from several threads at once, all of them hammer
+// the same blocks.
+// @returns a value depending on the work done, to keep it from being
+//     optimized away.
+unsigned int BenchmarkHotPath();
+
+}  // namespace testing
+
+#endif  // SYZYGY_INTEGRATION_TESTS_BENCHMARK_TESTS_H_
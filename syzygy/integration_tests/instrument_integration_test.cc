@@ -45,10 +45,9 @@ using trace::parser::Parser;
 typedef block_graph::BlockGraph::Block Block;
 typedef block_graph::BlockGraph::BlockMap BlockMap;
 typedef common::Application<InstrumentApp> TestApp;
-typedef grinder::CoverageData::LineExecutionCountMap LineExecutionCountMap;
 typedef grinder::CoverageData::SourceFileCoverageData SourceFileCoverageData;
-typedef grinder::CoverageData::SourceFileCoverageDataMap
-    SourceFileCoverageDataMap;
+typedef grinder::CoverageData::SourceFileCoverageDataVector
+    SourceFileCoverageDataVector;
 
 enum AccessMode {
   ASAN_READ_ACCESS = agent::asan::HeapProxy::ASAN_READ_ACCESS,
@@ -582,10 +581,8 @@ class InstrumentAppIntegrationTest : public testing::PELibUnitTest {
   bool GetLineInfoExecution(const SourceFileCoverageData* data, size_t line) {
     DCHECK(data != NULL);
 
-    const LineExecutionCountMap& lines = data->line_execution_count_map;
-    LineExecutionCountMap::const_iterator look = lines.find(line);
-    if (look != lines.end()) {
-      if (look->second != 0)
+    if (data->IsInstrumented(line)) {
+      if (data->line_execution_counts[line] != 0)
         return true;
     }
 
@@ -616,15 +613,14 @@ class InstrumentAppIntegrationTest : public testing::PELibUnitTest {
 
     // Retrieve coverage information.
     const grinder::CoverageData& coverage_data = grinder.coverage_data();
-    const SourceFileCoverageDataMap& files =
-        coverage_data.source_file_coverage_data_map();
+    const SourceFileCoverageDataVector& files = coverage_data.source_files();
 
     // Find file "coverage_tests.cc".
-    SourceFileCoverageDataMap::const_iterator file = files.begin();
+    SourceFileCoverageDataVector::const_iterator file = files.begin();
     const SourceFileCoverageData* data = NULL;
     for (; file != files.end(); ++file) {
-      if (EndsWith(file->first, "coverage_tests.cc", true)) {
-        data = &file->second;
+      if (EndsWith(file->source_file_name, "coverage_tests.cc", true)) {
+        data = &(*file);
         break;
       }
     }
@@ -48,6 +48,34 @@
         },
       },
     },
+    {
+      'target_name': 'agent_benchmarks',
+      'type': 'executable',
+      'sources': [
+        'agent_benchmarks.cc',
+        'integration_tests_main.cc',
+      ],
+      'dependencies': [
+        'integration_tests_dll',
+        '<(src)/syzygy/agent/asan/asan.gyp:syzyasan_rtl',
+        '<(src)/syzygy/agent/basic_block_entry/basic_block_entry.gyp:'
+            'basic_block_entry_client',
+        '<(src)/syzygy/agent/profiler/profiler.gyp:profile_client',
+        '<(src)/syzygy/core/core.gyp:core_unittest_utils',
+        '<(src)/syzygy/instrument/instrument.gyp:instrument_lib',
+        '<(src)/syzygy/pe/pe.gyp:pe_unittest_utils',
+        '<(src)/syzygy/trace/common/common.gyp:trace_unittest_utils',
+        '<(src)/syzygy/trace/service/service.gyp:call_trace_service_exe',
+        '<(src)/testing/gtest.gyp:gtest',
+      ],
+      'msvs_settings': {
+        'VCLinkerTool': {
+          # The agents have to run with the same address space settings as in
+          # the integration tests.
+          'LargeAddressAware': 1,
+        },
+      },
+    },
     {
       'target_name': 'integration_tests_dll',
       'type': 'loadable_module',
@@ -57,6 +85,8 @@
         'asan_interceptors_tests.cc',
         'bb_entry_tests.cc',
         'bb_entry_tests.h',
+        'benchmark_tests.cc',
+        'benchmark_tests.h',
         'behavior_tests.cc',
         'behavior_tests.h',
         'coverage_tests.cc',
@@ -20,6 +20,7 @@
 #include "syzygy/integration_tests/asan_check_tests.h"
 #include "syzygy/integration_tests/asan_interceptors_tests.h"
 #include "syzygy/integration_tests/bb_entry_tests.h"
+#include "syzygy/integration_tests/benchmark_tests.h"
 #include "syzygy/integration_tests/behavior_tests.h"
 #include "syzygy/integration_tests/coverage_tests.h"
 #include "syzygy/integration_tests/profile_tests.h"
@@ -244,6 +245,10 @@ unsigned int CALLBACK EndToEndTest(testing::EndToEndTestId test) {
       return testing::CallExportedFunction();
     case testing::kProfileGetMyRVA:
       return testing::GetMyRVA();
+
+    // Benchmark cases.
+    case testing::kBenchmarkHotPath:
+      return testing::BenchmarkHotPath();
   }
   return 0;
 }
@@ -129,6 +129,8 @@ enum EndToEndTestId {
 
   kProfileCallExport,
   kProfileGetMyRVA,
+
+  kBenchmarkHotPath,
 };
 
 }  // namespace testing
@@ -23,11 +23,33 @@
       'sources': [
         'optimize_app.h',
         'optimize_app.cc',
+        'orderers/cold_block_orderer.cc',
+        'orderers/cold_block_orderer.h',
+        'transforms/basic_block_reordering_transform.cc',
+        'transforms/basic_block_reordering_transform.h',
+        'transforms/frequency_util.cc',
+        'transforms/frequency_util.h',
+        'transforms/hot_code_alignment_transform.cc',
+        'transforms/hot_code_alignment_transform.h',
+        'transforms/inlining_transform.cc',
+        'transforms/inlining_transform.h',
+        'transforms/jump_table_specialization_transform.cc',
+        'transforms/jump_table_specialization_transform.h',
+        'transforms/peephole_transform.cc',
+        'transforms/peephole_transform.h',
       ],
       'dependencies': [
         '<(src)/base/base.gyp:base',
         '<(src)/sawbuck/common/common.gyp:common',
+        '<(src)/syzygy/block_graph/block_graph.gyp:block_graph_lib',
+        '<(src)/syzygy/block_graph/analysis/block_graph_analysis.gyp:'
+            'block_graph_analysis_lib',
+        '<(src)/syzygy/block_graph/orderers/block_graph_orderers.gyp:'
+            'block_graph_orderers_lib',
+        '<(src)/syzygy/block_graph/transforms/block_graph_transforms.gyp:'
+            'block_graph_transforms_lib',
         '<(src)/syzygy/common/common.gyp:common_lib',
+        '<(src)/syzygy/grinder/grinder.gyp:grinder_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
         '<(src)/syzygy/pe/transforms/pe_transforms.gyp:pe_transforms_lib',
       ],
@@ -49,13 +71,24 @@
       'sources': [
         'optimize_app_unittest.cc',
         'optimize_unittests_main.cc',
+        'orderers/cold_block_orderer_unittest.cc',
+        'transforms/basic_block_reordering_transform_unittest.cc',
+        'transforms/frequency_util_unittest.cc',
+        'transforms/hot_code_alignment_transform_unittest.cc',
+        'transforms/inlining_transform_unittest.cc',
+        'transforms/jump_table_specialization_transform_unittest.cc',
+        'transforms/peephole_transform_unittest.cc',
+        'unittest_util.cc',
+        'unittest_util.h',
       ],
       'dependencies': [
         'optimize_lib',
         '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/block_graph/block_graph.gyp:block_graph_unittest_lib',
         '<(src)/syzygy/core/core.gyp:core_unittest_utils',
         '<(src)/syzygy/pe/pe.gyp:pe_unittest_utils',
         '<(src)/syzygy/pe/pe.gyp:test_dll',
+        '<(src)/syzygy/test_data/test_data.gyp:basic_block_entry_counts',
         '<(src)/syzygy/test_data/test_data.gyp:test_dll_order_json',
         '<(src)/testing/gmock.gyp:gmock',
         '<(src)/testing/gtest.gyp:gtest',
@@ -14,19 +14,50 @@
 
 #include "syzygy/optimize/optimize_app.h"
 
+#include "base/memory/scoped_ptr.h"
+#include "syzygy/block_graph/orderers/original_orderer.h"
+#include "syzygy/grinder/basic_block_util.h"
+#include "syzygy/grinder/indexed_frequency_data_serializer.h"
+#include "syzygy/optimize/orderers/cold_block_orderer.h"
+#include "syzygy/optimize/transforms/basic_block_reordering_transform.h"
+#include "syzygy/optimize/transforms/hot_code_alignment_transform.h"
+#include "syzygy/optimize/transforms/inlining_transform.h"
+#include "syzygy/optimize/transforms/jump_table_specialization_transform.h"
+#include "syzygy/optimize/transforms/peephole_transform.h"
 #include "syzygy/pe/pe_relinker.h"
+#include "syzygy/pe/transforms/pe_remove_import_thunks_transform.h"
 
 namespace optimize {
 
 namespace {
 
+using grinder::basic_block_util::IndexedFrequencyInformation;
+using block_graph::orderers::OriginalOrderer;
+using grinder::basic_block_util::ModuleIndexedFrequencyMap;
+using optimize::orderers::ColdBlockOrderer;
+using optimize::transforms::BasicBlockReorderingTransform;
+using optimize::transforms::HotCodeAlignmentTransform;
+using optimize::transforms::InliningTransform;
+using optimize::transforms::JumpTableSpecializationTransform;
+using optimize::transforms::PeepholeTransform;
+using pe::transforms::PERemoveImportThunksTransform;
+
 const char kUsageFormatStr[] =
     "Usage: %ls [options]\n"
     "  Required Options:\n"
     "    --input-image=<path>  The input image file to optimize.\n"
     "    --output-image=<path> Output path for the rewritten image file.\n"
     "  Options:\n"
-    "    --branch-file=<path>  Branch statistics in JSON format.\n"
+    "    --branch-file=<path>  Branch statistics in JSON format. The basic\n"
+    "                          blocks of the profiled functions get laid out\n"
+    "                          so that their hot paths fall through, and\n"
+    "                          their code which never ran gets moved to the\n"
+    "                          end of the section. Their hot entries and\n"
+    "                          hot loops get aligned, the tiny functions\n"
+    "                          they call get inlined, the dominant cases of\n"
+    "                          their switches get tested ahead of the jump\n"
+    "                          tables, and their hot code gets peephole\n"
+    "                          optimized.\n"
     "    --input-pdb=<path>    The PDB file associated with the input DLL.\n"
     "                          Default is inferred from input-image.\n"
     "    --output-pdb=<path>   Output path for the rewritten PDB file.\n"
@@ -81,6 +112,77 @@ int OptimizeApp::Run() {
     return 1;
   }
 
+  // Lay out the basic blocks of the profiled functions so that their hot
+  // paths fall through, and move their cold code out of the way.
+  ModuleIndexedFrequencyMap frequency_map;
+  scoped_ptr<BasicBlockReorderingTransform> reordering_transform;
+  scoped_ptr<JumpTableSpecializationTransform> jump_table_transform;
+  scoped_ptr<InliningTransform> inlining_transform;
+  scoped_ptr<PeepholeTransform> peephole_transform;
+  scoped_ptr<HotCodeAlignmentTransform> alignment_transform;
+  OriginalOrderer original_orderer;
+  scoped_ptr<ColdBlockOrderer> cold_block_orderer;
+  if (!branch_file_path_.empty()) {
+    grinder::IndexedFrequencyDataSerializer serializer;
+    if (!serializer.Load(branch_file_path_, &frequency_map)) {
+      LOG(ERROR) << "Unable to load the branch statistics: "
+                 << branch_file_path_.value() << ".";
+      return 1;
+    }
+
+    pe::PEFile::Signature signature;
+    relinker.input_pe_file().GetSignature(&signature);
+    const IndexedFrequencyInformation* frequencies = NULL;
+    if (!grinder::basic_block_util::FindIndexedFrequencyInfo(
+            signature, frequency_map, &frequencies)) {
+      LOG(ERROR) << "The branch statistics don't match the input image.";
+      return 1;
+    }
+    DCHECK(frequencies != NULL);
+
+    reordering_transform.reset(
+        new BasicBlockReorderingTransform(&frequencies->frequency_map));
+    reordering_transform->set_split_cold_code(true);
+    relinker.AppendTransform(reordering_transform.get());
+
+    // These rewrite the blocks as laid out by the reordering, mapping them
+    // back to the profile through their source ranges.
+    jump_table_transform.reset(
+        new JumpTableSpecializationTransform(&frequencies->frequency_map));
+    relinker.AppendTransform(jump_table_transform.get());
+    inlining_transform.reset(
+        new InliningTransform(&frequencies->frequency_map));
+    relinker.AppendTransform(inlining_transform.get());
+
+    // The peephole rewrites depend on the final layout of the basic blocks.
+    peephole_transform.reset(
+        new PeepholeTransform(&frequencies->frequency_map));
+    relinker.AppendTransform(peephole_transform.get());
+
+    alignment_transform.reset(
+        new HotCodeAlignmentTransform(&frequencies->frequency_map));
+
+    // The cold blocks only exist once the transforms have been applied, the
+    // orderer picks them up from the transform then. The original orderer
+    // has to be given explicitly as it's only the default when there are no
+    // other orderers.
+    cold_block_orderer.reset(
+        new ColdBlockOrderer(&reordering_transform->cold_blocks()));
+    relinker.AppendOrderer(&original_orderer);
+    relinker.AppendOrderer(cold_block_orderer.get());
+  }
+
+  // Call the imported functions directly through the IAT. This rewrites the
+  // callers of the thunks, so it has to come after the transforms relying on
+  // the original addresses of the blocks.
+  PERemoveImportThunksTransform import_thunks_transform;
+  relinker.AppendTransform(&import_thunks_transform);
+
+  // The alignment has to come last, the basic-block alignments don't survive
+  // another decomposition.
+  if (alignment_transform.get() != NULL)
+    relinker.AppendTransform(alignment_transform.get());
+
   // TODO(etienneb) Add more transform / re-ordering here.
 
   // Perform the actual relink.
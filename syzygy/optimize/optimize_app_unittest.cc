@@ -198,4 +198,17 @@ TEST_F(OptimizeAppTest, RelinkDecompose) {
   ASSERT_NO_FATAL_FAILURE(CheckTestDll(output_image_path_));
 }
 
+TEST_F(OptimizeAppTest, RelinkWithBasicBlockReordering) {
+  base::FilePath entry_counts_path = testing::GetExeTestDataRelativePath(
+      L"basic_block_entry_traces\\entry_counts.json");
+
+  cmd_line_.AppendSwitchPath("input-image", input_image_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_image_path_);
+  cmd_line_.AppendSwitchPath("branch-file", entry_counts_path);
+  cmd_line_.AppendSwitch("overwrite");
+
+  ASSERT_EQ(0, test_app_.Run());
+  ASSERT_NO_FATAL_FAILURE(CheckTestDll(output_image_path_));
+}
+
 }  // namespace optimize
@@ -0,0 +1,53 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/optimize/orderers/cold_block_orderer.h"
+
+#include "base/logging.h"
+
+namespace optimize {
+namespace orderers {
+
+const char ColdBlockOrderer::kOrdererName[] = "ColdBlockOrderer";
+
+ColdBlockOrderer::ColdBlockOrderer(const BlockVector* cold_blocks)
+    : cold_blocks_(cold_blocks) {
+  DCHECK(cold_blocks != NULL);
+}
+
+bool ColdBlockOrderer::OrderBlockGraph(OrderedBlockGraph* ordered_block_graph,
+                                       BlockGraph::Block* header_block) {
+  DCHECK(ordered_block_graph != NULL);
+  DCHECK(header_block != NULL);
+
+  const BlockGraph* block_graph = ordered_block_graph->block_graph();
+  for (size_t i = 0; i < cold_blocks_->size(); ++i) {
+    BlockGraph::Block* block = (*cold_blocks_)[i];
+    DCHECK(block != NULL);
+
+    const BlockGraph::Section* section =
+        block_graph->GetSectionById(block->section());
+    if (section == NULL) {
+      LOG(ERROR) << "Cold block \"" << block->name() << "\" has no section.";
+      return false;
+    }
+
+    ordered_block_graph->PlaceAtTail(section, block);
+  }
+
+  return true;
+}
+
+}  // namespace orderers
+}  // namespace optimize
@@ -0,0 +1,61 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares an orderer which moves the cold blocks to the end of their
+// sections, out of the way of the hot code.
+
+#ifndef SYZYGY_OPTIMIZE_ORDERERS_COLD_BLOCK_ORDERER_H_
+#define SYZYGY_OPTIMIZE_ORDERERS_COLD_BLOCK_ORDERER_H_
+
+#include "syzygy/block_graph/orderers/named_orderer.h"
+
+namespace optimize {
+namespace orderers {
+
+// An orderer which places a given set of cold blocks at the tail of their
+// respective sections, in the order in which they are given. The other blocks
+// keep the order they already have, so this is meant to be applied after the
+// orderer which lays out the image as a whole.
+class ColdBlockOrderer
+    : public block_graph::orderers::NamedOrdererImpl<ColdBlockOrderer> {
+ public:
+  typedef block_graph::BlockGraph BlockGraph;
+  typedef block_graph::BlockVector BlockVector;
+  typedef block_graph::OrderedBlockGraph OrderedBlockGraph;
+
+  // Initializes a new ColdBlockOrderer instance.
+  // @param cold_blocks The blocks to move out of the way. This must outlive
+  //     the orderer.
+  explicit ColdBlockOrderer(const BlockVector* cold_blocks);
+
+  // Applies this orderer to the provided block graph.
+  // @param ordered_block_graph the block graph to order.
+  // @param header_block The header block of the block graph to transform.
+  // @returns true on success, false otherwise.
+  virtual bool OrderBlockGraph(OrderedBlockGraph* ordered_block_graph,
+                               BlockGraph::Block* header_block) OVERRIDE;
+
+  static const char kOrdererName[];
+
+ private:
+  // The blocks to move out of the way.
+  const BlockVector* cold_blocks_;
+
+  DISALLOW_COPY_AND_ASSIGN(ColdBlockOrderer);
+};
+
+}  // namespace orderers
+}  // namespace optimize
+
+#endif  // SYZYGY_OPTIMIZE_ORDERERS_COLD_BLOCK_ORDERER_H_
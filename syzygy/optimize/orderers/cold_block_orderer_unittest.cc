@@ -0,0 +1,78 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/optimize/orderers/cold_block_orderer.h"
+
+#include "gtest/gtest.h"
+
+namespace optimize {
+namespace orderers {
+
+namespace {
+
+using block_graph::BlockGraph;
+using block_graph::BlockVector;
+using block_graph::OrderedBlockGraph;
+
+}  // namespace
+
+TEST(ColdBlockOrdererTest, PlacesColdBlocksAtTail) {
+  BlockGraph block_graph;
+  BlockGraph::Section* text = block_graph.AddSection(".text", 0);
+  BlockGraph::Section* data = block_graph.AddSection(".data", 0);
+  BlockGraph::Block* header =
+      block_graph.AddBlock(BlockGraph::DATA_BLOCK, 10, "header");
+  ASSERT_TRUE(header != NULL);
+
+  BlockVector code_blocks;
+  for (size_t i = 0; i < 4; ++i) {
+    BlockGraph::Block* block =
+        block_graph.AddBlock(BlockGraph::CODE_BLOCK, 10, "code");
+    ASSERT_TRUE(block != NULL);
+    block->set_section(text->id());
+    code_blocks.push_back(block);
+  }
+  BlockGraph::Block* data_block =
+      block_graph.AddBlock(BlockGraph::DATA_BLOCK, 10, "data");
+  ASSERT_TRUE(data_block != NULL);
+  data_block->set_section(data->id());
+
+  BlockVector cold_blocks;
+  cold_blocks.push_back(code_blocks[2]);
+  cold_blocks.push_back(code_blocks[0]);
+
+  OrderedBlockGraph ordered_block_graph(&block_graph);
+  ColdBlockOrderer orderer(&cold_blocks);
+  EXPECT_TRUE(orderer.OrderBlockGraph(&ordered_block_graph, header));
+
+  // The hot blocks keep their order, and the cold ones follow them in the
+  // given order.
+  const BlockGraph::Block* kExpectedOrder[] = {
+      code_blocks[1], code_blocks[3], code_blocks[2], code_blocks[0] };
+  OrderedBlockGraph::BlockList::const_iterator it =
+      ordered_block_graph.begin(text);
+  for (size_t i = 0; i < arraysize(kExpectedOrder); ++i, ++it) {
+    ASSERT_TRUE(it != ordered_block_graph.end(text));
+    EXPECT_EQ(kExpectedOrder[i], *it);
+  }
+  EXPECT_TRUE(it == ordered_block_graph.end(text));
+
+  // The other sections are untouched.
+  it = ordered_block_graph.begin(data);
+  ASSERT_TRUE(it != ordered_block_graph.end(data));
+  EXPECT_EQ(data_block, *it);
+}
+
+}  // namespace orderers
+}  // namespace optimize
@@ -0,0 +1,258 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/optimize/transforms/basic_block_reordering_transform.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "base/logging.h"
+#include "base/string_util.h"
+#include "syzygy/block_graph/basic_block.h"
+
+namespace optimize {
+namespace transforms {
+
+namespace {
+
+using block_graph::BasicBlock;
+using block_graph::BasicCodeBlock;
+
+typedef BasicBlockReorderingTransform::EntryCountType EntryCountType;
+
+// A code basic block along with its entry count.
+struct HotBasicBlock {
+  HotBasicBlock(BasicCodeBlock* bb, EntryCountType count)
+      : bb(bb), count(count) {
+  }
+
+  BasicCodeBlock* bb;
+  EntryCountType count;
+};
+
+bool IsHotter(const HotBasicBlock& lhs, const HotBasicBlock& rhs) {
+  return lhs.count > rhs.count;
+}
+
+}  // namespace
+
+const char BasicBlockReorderingTransform::kTransformName[] =
+    "BasicBlockReorderingTransform";
+const char BasicBlockReorderingTransform::kColdBlockSuffix[] = ".cold";
+
+BasicBlockReorderingTransform::BasicBlockReorderingTransform(
+    const IndexedFrequencyMap* frequencies)
+    : frequencies_(frequencies), split_cold_code_(false) {
+  DCHECK(frequencies != NULL);
+}
+
+bool BasicBlockReorderingTransform::OnBlock(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockGraph::Block* block) {
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+  DCHECK(block != NULL);
+
+  if (block->type() != BlockGraph::CODE_BLOCK)
+    return true;
+
+  // Leave the blocks that were never executed alone, there's nothing to gain
+  // from decomposing them.
+  if (!HasProfileInformation(block))
+    return true;
+
+  if (!policy->CodeBlockIsSafeToBasicBlockDecompose(block))
+    return true;
+
+  block_graph::BlockVector new_blocks;
+  if (!ApplyBasicBlockSubGraphTransform(this, policy, block_graph, block,
+                                        &new_blocks)) {
+    return false;
+  }
+
+  // Keep track of the cold parts of the block, if any.
+  for (size_t i = 0; i < new_blocks.size(); ++i) {
+    if (EndsWith(new_blocks[i]->name(), kColdBlockSuffix, true))
+      cold_blocks_.push_back(new_blocks[i]);
+  }
+
+  return true;
+}
+
+bool BasicBlockReorderingTransform::TransformBasicBlockSubGraph(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BasicBlockSubGraph* basic_block_subgraph) {
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+  DCHECK(basic_block_subgraph != NULL);
+  DCHECK(basic_block_subgraph->original_block() != NULL);
+
+  // The cold parts are appended to the list of block descriptions, they must
+  // not be visited.
+  BasicBlockSubGraph::BlockDescriptionList& descriptions =
+      basic_block_subgraph->block_descriptions();
+  size_t description_count = descriptions.size();
+  BasicBlockSubGraph::BlockDescriptionList::iterator it = descriptions.begin();
+  for (size_t i = 0; i < description_count; ++i, ++it) {
+    BasicBlockSubGraph::BasicBlockOrdering cold_bbs;
+    ReorderBasicBlocks(basic_block_subgraph->original_block(),
+                       &it->basic_block_order,
+                       split_cold_code_ ? &cold_bbs : NULL);
+    if (cold_bbs.empty())
+      continue;
+
+    BasicBlockSubGraph::BlockDescription* cold_description =
+        basic_block_subgraph->AddBlockDescription(
+            it->name + kColdBlockSuffix,
+            it->compiland_name,
+            it->type,
+            it->section,
+            it->alignment,
+            it->attributes);
+    DCHECK(cold_description != NULL);
+    cold_description->basic_block_order.swap(cold_bbs);
+  }
+
+  return true;
+}
+
+bool BasicBlockReorderingTransform::HasProfileInformation(
+    const BlockGraph::Block* block) const {
+  DCHECK(block != NULL);
+
+  // The frequencies are sorted by address, so the first one at or past the
+  // start of the block tells whether any of them falls within it.
+  IndexedFrequencyMap::const_iterator it =
+      frequencies_->lower_bound(std::make_pair(block->addr(), 0U));
+  for (; it != frequencies_->end(); ++it) {
+    if (it->first.first >= block->addr() + block->size())
+      return false;
+    if (it->first.second == 0 && it->second != 0)
+      return true;
+  }
+  return false;
+}
+
+EntryCountType BasicBlockReorderingTransform::GetEntryCount(
+    RelativeAddress address) const {
+  // The entry count is the first column of both the basic-block entry and
+  // the branch frequencies.
+  IndexedFrequencyMap::const_iterator it =
+      frequencies_->find(std::make_pair(address, 0U));
+  if (it == frequencies_->end())
+    return 0;
+  return it->second;
+}
+
+void BasicBlockReorderingTransform::ReorderBasicBlocks(
+    const BlockGraph::Block* original_block,
+    BasicBlockSubGraph::BasicBlockOrdering* order,
+    BasicBlockSubGraph::BasicBlockOrdering* cold_bbs) const {
+  DCHECK(original_block != NULL);
+  DCHECK(order != NULL);
+
+  // Split the basic blocks into the code ones, with their entry counts, and
+  // the others.
+  std::vector<HotBasicBlock> code_bbs;
+  std::vector<BasicBlock*> other_bbs;
+  BasicBlockSubGraph::BasicBlockOrdering::const_iterator it = order->begin();
+  for (; it != order->end(); ++it) {
+    BasicCodeBlock* code_bb = BasicCodeBlock::Cast(*it);
+    if (code_bb == NULL) {
+      other_bbs.push_back(*it);
+      continue;
+    }
+
+    EntryCountType count = 0;
+    if (code_bb->offset() != BasicBlock::kNoOffset)
+      count = GetEntryCount(original_block->addr() + code_bb->offset());
+    code_bbs.push_back(HotBasicBlock(code_bb, count));
+  }
+
+  if (code_bbs.empty())
+    return;
+
+  std::map<const BasicBlock*, EntryCountType> counts;
+  for (size_t i = 0; i < code_bbs.size(); ++i)
+    counts[code_bbs[i].bb] = code_bbs[i].count;
+
+  // The chains of hot basic blocks start at the entry of the block, then at
+  // the hottest basic block left over. The sort is stable so that the basic
+  // blocks with the same count keep their relative order.
+  std::vector<HotBasicBlock> chain_heads(code_bbs.begin() + 1,
+                                         code_bbs.end());
+  std::stable_sort(chain_heads.begin(), chain_heads.end(), &IsHotter);
+  std::vector<HotBasicBlock>::const_iterator next_head = chain_heads.begin();
+
+  BasicBlockSubGraph::BasicBlockOrdering new_order;
+  std::set<const BasicBlock*> placed;
+  BasicCodeBlock* current = code_bbs.front().bb;
+  while (current != NULL) {
+    new_order.push_back(current);
+    placed.insert(current);
+
+    // Continue the chain with the hottest successor that hasn't been placed
+    // yet, so that it becomes the fall-through.
+    BasicCodeBlock* next = NULL;
+    EntryCountType next_count = 0;
+    BasicBlock::Successors::const_iterator succ_it =
+        current->successors().begin();
+    for (; succ_it != current->successors().end(); ++succ_it) {
+      BasicCodeBlock* successor =
+          BasicCodeBlock::Cast(succ_it->reference().basic_block());
+      if (successor == NULL || placed.count(successor) != 0)
+        continue;
+      EntryCountType count = counts[successor];
+      if (count > next_count) {
+        next = successor;
+        next_count = count;
+      }
+    }
+
+    // Otherwise start a new chain at the hottest basic block left over.
+    while (next == NULL && next_head != chain_heads.end() &&
+           next_head->count != 0) {
+      if (placed.count(next_head->bb) == 0)
+        next = next_head->bb;
+      ++next_head;
+    }
+
+    current = next;
+  }
+
+  // The cold code goes after the hot code, or in its own block, in its
+  // original order. The data goes last.
+  size_t cold_bb_count = 0;
+  for (size_t i = 0; i < code_bbs.size(); ++i) {
+    if (placed.count(code_bbs[i].bb) != 0)
+      continue;
+    ++cold_bb_count;
+    if (cold_bbs != NULL)
+      cold_bbs->push_back(code_bbs[i].bb);
+    else
+      new_order.push_back(code_bbs[i].bb);
+  }
+  new_order.insert(new_order.end(), other_bbs.begin(), other_bbs.end());
+
+  DCHECK_EQ(order->size(),
+            new_order.size() + (cold_bbs != NULL ? cold_bb_count : 0));
+  order->swap(new_order);
+}
+
+}  // namespace transforms
+}  // namespace optimize
@@ -0,0 +1,135 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the basic-block reordering transform, which lays out the basic
+// blocks of each function according to their profiled entry counts so that
+// the hot paths fall through.
+
+#ifndef SYZYGY_OPTIMIZE_TRANSFORMS_BASIC_BLOCK_REORDERING_TRANSFORM_H_
+#define SYZYGY_OPTIMIZE_TRANSFORMS_BASIC_BLOCK_REORDERING_TRANSFORM_H_
+
+#include "syzygy/block_graph/transforms/iterative_transform.h"
+#include "syzygy/block_graph/transforms/named_transform.h"
+#include "syzygy/grinder/basic_block_util.h"
+
+namespace optimize {
+namespace transforms {
+
+// An iterative block transformation that reorders the basic blocks within
+// each code block which has profile information. The layout is built
+// greedily: starting at the entry of the block, each basic block is followed
+// by its most frequently executed successor that hasn't been placed yet, and
+// when there is none, by the hottest remaining basic block. The basic blocks
+// which were never executed go last, in their original order, followed by
+// the data basic blocks.
+//
+// The conditional branches are inverted as a matter of course: the block
+// builder elides the successor which falls through to the next basic block
+// in the layout, and manifests the other one with the matching condition.
+//
+// Optionally, the code which was never executed gets split out of each
+// profiled block into a separate cold block, so that it doesn't dilute the
+// hot code in the cache lines and pages. The cold blocks can then be moved
+// out of the way by the ColdBlockOrderer.
+class BasicBlockReorderingTransform
+    : public block_graph::transforms::IterativeTransformImpl<
+          BasicBlockReorderingTransform>,
+      public block_graph::transforms::NamedBasicBlockSubGraphTransformImpl<
+          BasicBlockReorderingTransform> {
+ public:
+  typedef block_graph::BasicBlockSubGraph BasicBlockSubGraph;
+  typedef block_graph::BlockGraph BlockGraph;
+  typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
+  typedef grinder::basic_block_util::EntryCountType EntryCountType;
+  typedef grinder::basic_block_util::IndexedFrequencyMap IndexedFrequencyMap;
+  typedef grinder::basic_block_util::RelativeAddress RelativeAddress;
+
+  // Initializes a new BasicBlockReorderingTransform instance.
+  // @param frequencies The basic-block frequencies of the image, keyed by the
+  //     address of the basic blocks in the original image. Either the
+  //     basic-block entry or the branch frequencies will do, as only their
+  //     entry counts are used. This must outlive the transform.
+  explicit BasicBlockReorderingTransform(
+      const IndexedFrequencyMap* frequencies);
+
+  // @name Accessors.
+  // @{
+  bool split_cold_code() const { return split_cold_code_; }
+  void set_split_cold_code(bool value) { split_cold_code_ = value; }
+  // @}
+
+  // @returns the cold blocks split out of the profiled blocks.
+  const block_graph::BlockVector& cold_blocks() const { return cold_blocks_; }
+
+  // The transform name.
+  static const char kTransformName[];
+
+  // The suffix appended to the name of a block to name its cold part.
+  static const char kColdBlockSuffix[];
+
+ protected:
+  friend IterativeTransformImpl<BasicBlockReorderingTransform>;
+
+  // @name IterativeTransformImpl implementation.
+  // @{
+  bool OnBlock(const TransformPolicyInterface* policy,
+               BlockGraph* block_graph,
+               BlockGraph::Block* block);
+  // @}
+
+  // @name BasicBlockSubGraphTransformInterface implementation.
+  // @{
+  virtual bool TransformBasicBlockSubGraph(
+      const TransformPolicyInterface* policy,
+      BlockGraph* block_graph,
+      BasicBlockSubGraph* basic_block_subgraph) OVERRIDE;
+  // @}
+
+  // @param block A code block of the original image.
+  // @returns true if any of the basic blocks of @p block were executed.
+  bool HasProfileInformation(const BlockGraph::Block* block) const;
+
+  // @param address The address of a basic block in the original image.
+  // @returns the entry count of the basic block, or zero if it wasn't
+  //     executed.
+  EntryCountType GetEntryCount(RelativeAddress address) const;
+
+  // Reorders the basic blocks of a single block description.
+  // @param original_block The block the basic blocks were decomposed from.
+  // @param order The basic block order to rearrange.
+  // @param cold_bbs If not NULL, the code basic blocks which were never
+  //     executed are moved from @p order to this ordering instead of being
+  //     placed after the hot ones.
+  void ReorderBasicBlocks(
+      const BlockGraph::Block* original_block,
+      BasicBlockSubGraph::BasicBlockOrdering* order,
+      BasicBlockSubGraph::BasicBlockOrdering* cold_bbs) const;
+
+  // The profiled basic-block frequencies.
+  const IndexedFrequencyMap* frequencies_;
+
+  // Indicates whether the cold code gets split into blocks of its own.
+  bool split_cold_code_;
+
+  // The cold blocks created so far.
+  block_graph::BlockVector cold_blocks_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(BasicBlockReorderingTransform);
+};
+
+}  // namespace transforms
+}  // namespace optimize
+
+#endif  // SYZYGY_OPTIMIZE_TRANSFORMS_BASIC_BLOCK_REORDERING_TRANSFORM_H_
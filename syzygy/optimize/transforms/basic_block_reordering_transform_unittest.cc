@@ -0,0 +1,147 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/optimize/transforms/basic_block_reordering_transform.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/block_builder.h"
+#include "syzygy/optimize/unittest_util.h"
+
+namespace optimize {
+namespace transforms {
+
+namespace {
+
+using block_graph::BasicBlock;
+using block_graph::BlockBuilder;
+
+class TestBasicBlockReorderingTransform
+    : public BasicBlockReorderingTransform {
+ public:
+  explicit TestBasicBlockReorderingTransform(
+      const IndexedFrequencyMap* frequencies)
+      : BasicBlockReorderingTransform(frequencies) {
+  }
+
+  using BasicBlockReorderingTransform::HasProfileInformation;
+  using BasicBlockReorderingTransform::TransformBasicBlockSubGraph;
+};
+
+class BasicBlockReorderingTransformTest
+    : public testing::BasicBlockFrequencyTest {
+ public:
+  // Makes case_1 and the default case hot, and the loop of case_0 warm. The
+  // padding basic blocks are never executed.
+  void SetEntryCounts() {
+    SetEntryCount(0, 10);
+    SetEntryCount(2, 2);
+    SetEntryCount(3, 4);
+    SetEntryCount(4, 2);
+    SetEntryCount(5, 8);
+    SetEntryCount(6, 8);
+  }
+
+  // Checks that @p order contains the basic blocks given by their indices.
+  void ExpectOrder(const BasicBlockSubGraph::BasicBlockOrdering& order,
+                   const size_t* expected_order,
+                   size_t expected_size) {
+    ASSERT_EQ(expected_size, order.size());
+    BasicBlockSubGraph::BasicBlockOrdering::const_iterator it = order.begin();
+    for (size_t i = 0; i < expected_size; ++i, ++it)
+      EXPECT_EQ(bbs_[expected_order[i]], *it) << "at position " << i;
+  }
+};
+
+}  // namespace
+
+TEST_F(BasicBlockReorderingTransformTest, HasProfileInformation) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+  ASSERT_NO_FATAL_FAILURE(InitBasicBlockSubGraph());
+  TestBasicBlockReorderingTransform transform(&frequencies_);
+
+  EXPECT_FALSE(transform.HasProfileInformation(assembly_func_));
+
+  // A zero count doesn't make the block hot.
+  SetEntryCount(0, 0);
+  EXPECT_FALSE(transform.HasProfileInformation(assembly_func_));
+
+  SetEntryCount(4, 1);
+  EXPECT_TRUE(transform.HasProfileInformation(assembly_func_));
+}
+
+TEST_F(BasicBlockReorderingTransformTest, HotPathFallsThrough) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+  ASSERT_NO_FATAL_FAILURE(InitBasicBlockSubGraph());
+  ASSERT_EQ(kNumBasicBlocks, bbs_.size());
+  ASSERT_EQ(1U, bds_.size());
+
+  SetEntryCounts();
+
+  TestBasicBlockReorderingTransform transform(&frequencies_);
+  ASSERT_TRUE(transform.TransformBasicBlockSubGraph(
+      &policy_, &block_graph_, &subgraph_));
+
+  // The entry comes first, then the hottest chain, case_1 falling through to
+  // the default case. The loop of case_0 comes next, followed by its
+  // predecessor, then the cold code and the data.
+  const size_t kExpectedOrder[] = { 0, 5, 6, 3, 4, 2, 1, 7, 8, 9 };
+  ASSERT_EQ(1U, subgraph_.block_descriptions().size());
+  ASSERT_NO_FATAL_FAILURE(ExpectOrder(bds_[0]->basic_block_order,
+                                      kExpectedOrder,
+                                      arraysize(kExpectedOrder)));
+
+  // The reordered subgraph must still be buildable.
+  BlockBuilder builder(&block_graph_);
+  EXPECT_TRUE(builder.Merge(&subgraph_));
+  EXPECT_EQ(1U, builder.new_blocks().size());
+}
+
+TEST_F(BasicBlockReorderingTransformTest, SplitColdCode) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+  ASSERT_NO_FATAL_FAILURE(InitBasicBlockSubGraph());
+  ASSERT_EQ(kNumBasicBlocks, bbs_.size());
+  ASSERT_EQ(1U, bds_.size());
+  SetEntryCounts();
+
+  TestBasicBlockReorderingTransform transform(&frequencies_);
+  EXPECT_FALSE(transform.split_cold_code());
+  transform.set_split_cold_code(true);
+  EXPECT_TRUE(transform.split_cold_code());
+  ASSERT_TRUE(transform.TransformBasicBlockSubGraph(
+      &policy_, &block_graph_, &subgraph_));
+
+  // The code which never ran goes to a block of its own, the data stays with
+  // the hot code.
+  ASSERT_EQ(2U, subgraph_.block_descriptions().size());
+  const size_t kExpectedHotOrder[] = { 0, 5, 6, 3, 4, 2, 8, 9 };
+  ASSERT_NO_FATAL_FAILURE(ExpectOrder(bds_[0]->basic_block_order,
+                                      kExpectedHotOrder,
+                                      arraysize(kExpectedHotOrder)));
+
+  const BlockDescription& cold = subgraph_.block_descriptions().back();
+  EXPECT_EQ(bds_[0]->name + BasicBlockReorderingTransform::kColdBlockSuffix,
+            cold.name);
+  EXPECT_EQ(bds_[0]->section, cold.section);
+  const size_t kExpectedColdOrder[] = { 1, 7 };
+  ASSERT_NO_FATAL_FAILURE(ExpectOrder(cold.basic_block_order,
+                                      kExpectedColdOrder,
+                                      arraysize(kExpectedColdOrder)));
+
+  BlockBuilder builder(&block_graph_);
+  EXPECT_TRUE(builder.Merge(&subgraph_));
+  EXPECT_EQ(2U, builder.new_blocks().size());
+}
+
+}  // namespace transforms
+}  // namespace optimize
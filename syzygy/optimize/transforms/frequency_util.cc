@@ -0,0 +1,81 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/optimize/transforms/frequency_util.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+
+namespace optimize {
+namespace transforms {
+
+using block_graph::BlockGraph;
+using grinder::basic_block_util::EntryCountType;
+using grinder::basic_block_util::IndexedFrequencyMap;
+using grinder::basic_block_util::RelativeAddress;
+
+EntryCountType GetMaxEntryCount(const IndexedFrequencyMap& frequencies) {
+  EntryCountType max_count = 0;
+  IndexedFrequencyMap::const_iterator it = frequencies.begin();
+  for (; it != frequencies.end(); ++it) {
+    if (it->first.second == 0)
+      max_count = std::max(max_count, it->second);
+  }
+  return max_count;
+}
+
+EntryCountType GetEntryCount(const IndexedFrequencyMap& frequencies,
+                             const BlockGraph::Block* block,
+                             BlockGraph::Offset offset) {
+  DCHECK(block != NULL);
+
+  const BlockGraph::Block::SourceRanges::RangePair* range_pair =
+      block->source_ranges().FindRangePair(offset, 1);
+  if (range_pair == NULL)
+    return 0;
+
+  RelativeAddress address =
+      range_pair->second.start() + (offset - range_pair->first.start());
+  IndexedFrequencyMap::const_iterator it =
+      frequencies.find(std::make_pair(address, 0U));
+  if (it == frequencies.end())
+    return 0;
+  return it->second;
+}
+
+bool HasHotCode(const IndexedFrequencyMap& frequencies,
+                const BlockGraph::Block* block,
+                EntryCountType hot_entry_count) {
+  DCHECK(block != NULL);
+
+  // Look up the profile for each range of the original image the block
+  // comes from.
+  BlockGraph::Block::SourceRanges::RangePairs::const_iterator range_it =
+      block->source_ranges().range_pairs().begin();
+  for (; range_it != block->source_ranges().range_pairs().end(); ++range_it) {
+    RelativeAddress start = range_it->second.start();
+    RelativeAddress end = range_it->second.end();
+    IndexedFrequencyMap::const_iterator it =
+        frequencies.lower_bound(std::make_pair(start, 0U));
+    for (; it != frequencies.end() && it->first.first < end; ++it) {
+      if (it->first.second == 0 && it->second >= hot_entry_count)
+        return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace transforms
+}  // namespace optimize
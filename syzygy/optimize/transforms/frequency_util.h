@@ -0,0 +1,59 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares utility functions for looking up the profiled entry counts of the
+// basic blocks of a block graph, shared by the profile guided transforms.
+//
+// The entry counts are the first column of both the basic-block entry and the
+// branch frequencies. The blocks are matched to the profile through their
+// source ranges, so these work on blocks that were rebuilt by other
+// transforms.
+
+#ifndef SYZYGY_OPTIMIZE_TRANSFORMS_FREQUENCY_UTIL_H_
+#define SYZYGY_OPTIMIZE_TRANSFORMS_FREQUENCY_UTIL_H_
+
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/grinder/basic_block_util.h"
+
+namespace optimize {
+namespace transforms {
+
+// @param frequencies The profiled basic-block frequencies.
+// @returns the largest entry count of @p frequencies.
+grinder::basic_block_util::EntryCountType GetMaxEntryCount(
+    const grinder::basic_block_util::IndexedFrequencyMap& frequencies);
+
+// @param frequencies The profiled basic-block frequencies.
+// @param block A code block.
+// @param offset The offset of a basic block in @p block.
+// @returns the entry count of the basic block, or zero if it doesn't map to
+//     the original image or wasn't executed.
+grinder::basic_block_util::EntryCountType GetEntryCount(
+    const grinder::basic_block_util::IndexedFrequencyMap& frequencies,
+    const block_graph::BlockGraph::Block* block,
+    block_graph::BlockGraph::Offset offset);
+
+// @param frequencies The profiled basic-block frequencies.
+// @param block A code block.
+// @param hot_entry_count The entry count from which a basic block is hot.
+// @returns true if any of the basic blocks of @p block is hot.
+bool HasHotCode(
+    const grinder::basic_block_util::IndexedFrequencyMap& frequencies,
+    const block_graph::BlockGraph::Block* block,
+    grinder::basic_block_util::EntryCountType hot_entry_count);
+
+}  // namespace transforms
+}  // namespace optimize
+
+#endif  // SYZYGY_OPTIMIZE_TRANSFORMS_FREQUENCY_UTIL_H_
@@ -0,0 +1,71 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/optimize/transforms/frequency_util.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/optimize/unittest_util.h"
+
+namespace optimize {
+namespace transforms {
+
+namespace {
+
+typedef testing::BasicBlockFrequencyTest FrequencyUtilTest;
+
+}  // namespace
+
+TEST_F(FrequencyUtilTest, GetMaxEntryCount) {
+  EXPECT_EQ(0, GetMaxEntryCount(frequencies_));
+
+  frequencies_[std::make_pair(RelativeAddress(0x1000), 0U)] = 5000;
+  frequencies_[std::make_pair(RelativeAddress(0x2000), 0U)] = 2;
+  EXPECT_EQ(5000, GetMaxEntryCount(frequencies_));
+
+  // The other columns don't hold entry counts.
+  frequencies_[std::make_pair(RelativeAddress(0x2000), 1U)] = 100000;
+  EXPECT_EQ(5000, GetMaxEntryCount(frequencies_));
+}
+
+TEST_F(FrequencyUtilTest, GetEntryCount) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+  ASSERT_NO_FATAL_FAILURE(InitBasicBlockSubGraph());
+  SetEntryCount(0, 10);
+  SetEntryCount(3, 5000);
+
+  EXPECT_EQ(10, GetEntryCount(frequencies_, assembly_func_, 0));
+  EXPECT_EQ(5000,
+            GetEntryCount(frequencies_, assembly_func_, bbs_[3]->offset()));
+  EXPECT_EQ(0, GetEntryCount(frequencies_, assembly_func_, bbs_[1]->offset()));
+
+  // A block that doesn't come from the original image has no entry count.
+  EXPECT_EQ(0, GetEntryCount(frequencies_, func1_, 0));
+}
+
+TEST_F(FrequencyUtilTest, HasHotCode) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+  ASSERT_NO_FATAL_FAILURE(InitBasicBlockSubGraph());
+  EXPECT_FALSE(HasHotCode(frequencies_, assembly_func_, 1));
+
+  SetEntryCount(3, 50);
+  EXPECT_TRUE(HasHotCode(frequencies_, assembly_func_, 1));
+  EXPECT_TRUE(HasHotCode(frequencies_, assembly_func_, 50));
+  EXPECT_FALSE(HasHotCode(frequencies_, assembly_func_, 51));
+
+  // A block that doesn't come from the original image is never hot.
+  EXPECT_FALSE(HasHotCode(frequencies_, func1_, 1));
+}
+
+}  // namespace transforms
+}  // namespace optimize
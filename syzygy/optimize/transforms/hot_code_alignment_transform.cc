@@ -0,0 +1,188 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/optimize/transforms/hot_code_alignment_transform.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+#include "base/logging.h"
+#include "syzygy/block_graph/basic_block.h"
+#include "syzygy/common/align.h"
+#include "syzygy/optimize/transforms/frequency_util.h"
+
+namespace optimize {
+namespace transforms {
+
+namespace {
+
+using block_graph::BasicBlock;
+using block_graph::BasicCodeBlock;
+
+typedef HotCodeAlignmentTransform::EntryCountType EntryCountType;
+typedef HotCodeAlignmentTransform::IndexedFrequencyMap IndexedFrequencyMap;
+
+}  // namespace
+
+const char HotCodeAlignmentTransform::kTransformName[] =
+    "HotCodeAlignmentTransform";
+const size_t HotCodeAlignmentTransform::kDefaultAlignment;
+const EntryCountType HotCodeAlignmentTransform::kDefaultHotEntryCountRatio;
+
+HotCodeAlignmentTransform::HotCodeAlignmentTransform(
+    const IndexedFrequencyMap* frequencies)
+    : frequencies_(frequencies),
+      alignment_(kDefaultAlignment),
+      hot_entry_count_(1),
+      aligned_function_count_(0),
+      aligned_loop_count_(0),
+      max_padding_size_(0) {
+  DCHECK(frequencies != NULL);
+  hot_entry_count_ = std::max<EntryCountType>(
+      1, GetMaxEntryCount(*frequencies) / kDefaultHotEntryCountRatio);
+}
+
+void HotCodeAlignmentTransform::set_alignment(size_t alignment) {
+  DCHECK(common::IsPowerOfTwo(alignment));
+  alignment_ = alignment;
+}
+
+void HotCodeAlignmentTransform::set_hot_entry_count(EntryCountType count) {
+  DCHECK_LT(0, count);
+  hot_entry_count_ = count;
+}
+
+bool HotCodeAlignmentTransform::OnBlock(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockGraph::Block* block) {
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+  DCHECK(block != NULL);
+
+  if (block->type() != BlockGraph::CODE_BLOCK)
+    return true;
+
+  if (!HasHotCode(*frequencies_, block, hot_entry_count_))
+    return true;
+
+  if (!policy->CodeBlockIsSafeToBasicBlockDecompose(block)) {
+    // The basic blocks are out of reach, but the entry of the block can
+    // still be aligned.
+    if (GetEntryCount(*frequencies_, block, 0) >= hot_entry_count_ &&
+        block->alignment() < alignment_) {
+      max_padding_size_ += alignment_ - block->alignment();
+      block->set_alignment(alignment_);
+      ++aligned_function_count_;
+    }
+    return true;
+  }
+
+  if (!ApplyBasicBlockSubGraphTransform(this, policy, block_graph, block, NULL))
+    return false;
+
+  return true;
+}
+
+bool HotCodeAlignmentTransform::PostBlockGraphIteration(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockGraph::Block* header_block) {
+  LOG(INFO) << "Aligned " << aligned_function_count_ << " hot functions and "
+            << aligned_loop_count_ << " hot loops to " << alignment_
+            << " bytes, for at most " << max_padding_size_
+            << " bytes of padding.";
+  return true;
+}
+
+bool HotCodeAlignmentTransform::TransformBasicBlockSubGraph(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BasicBlockSubGraph* basic_block_subgraph) {
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+  DCHECK(basic_block_subgraph != NULL);
+
+  const BlockGraph::Block* original_block =
+      basic_block_subgraph->original_block();
+  DCHECK(original_block != NULL);
+
+  BasicBlockSubGraph::BlockDescriptionList::iterator desc_it =
+      basic_block_subgraph->block_descriptions().begin();
+  for (; desc_it != basic_block_subgraph->block_descriptions().end();
+       ++desc_it) {
+    BasicBlockSubGraph::BasicBlockOrdering& order = desc_it->basic_block_order;
+    if (order.empty())
+      continue;
+
+    // Number the basic blocks in layout order, to tell the backward branches
+    // apart.
+    std::map<const BasicBlock*, size_t> positions;
+    BasicBlockSubGraph::BasicBlockOrdering::iterator bb_it = order.begin();
+    for (size_t i = 0; bb_it != order.end(); ++bb_it, ++i)
+      positions[*bb_it] = i;
+
+    // Find the hot basic blocks that are the target of a backward branch.
+    std::set<BasicBlock*> loop_heads;
+    for (bb_it = order.begin(); bb_it != order.end(); ++bb_it) {
+      BasicCodeBlock* bb = BasicCodeBlock::Cast(*bb_it);
+      if (bb == NULL)
+        continue;
+
+      BasicBlock::Successors::const_iterator succ_it =
+          bb->successors().begin();
+      for (; succ_it != bb->successors().end(); ++succ_it) {
+        BasicBlock* target = succ_it->reference().basic_block();
+        if (target == NULL || positions.count(target) == 0)
+          continue;
+        if (positions[target] > positions[bb])
+          continue;
+        if (target->offset() == BasicBlock::kNoOffset ||
+            GetEntryCount(*frequencies_, original_block, target->offset()) <
+                hot_entry_count_) {
+          continue;
+        }
+        loop_heads.insert(target);
+      }
+    }
+
+    // Align the entry of the block if it's hot. This also takes care of a
+    // loop head at the very beginning of the block.
+    BasicBlock* first_bb = order.front();
+    if (first_bb->offset() != BasicBlock::kNoOffset &&
+        GetEntryCount(*frequencies_, original_block, first_bb->offset()) >=
+            hot_entry_count_ &&
+        desc_it->alignment < alignment_) {
+      max_padding_size_ += alignment_ - desc_it->alignment;
+      desc_it->alignment = alignment_;
+      ++aligned_function_count_;
+    }
+    loop_heads.erase(first_bb);
+
+    std::set<BasicBlock*>::iterator head_it = loop_heads.begin();
+    for (; head_it != loop_heads.end(); ++head_it) {
+      if ((*head_it)->alignment() >= alignment_)
+        continue;
+      max_padding_size_ += alignment_ - 1;
+      (*head_it)->set_alignment(alignment_);
+      ++aligned_loop_count_;
+    }
+  }
+
+  return true;
+}
+
+}  // namespace transforms
+}  // namespace optimize
@@ -0,0 +1,127 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the hot code alignment transform, which aligns the entries of the
+// hot functions and the heads of their hot loops according to their
+// profiled entry counts.
+
+#ifndef SYZYGY_OPTIMIZE_TRANSFORMS_HOT_CODE_ALIGNMENT_TRANSFORM_H_
+#define SYZYGY_OPTIMIZE_TRANSFORMS_HOT_CODE_ALIGNMENT_TRANSFORM_H_
+
+#include "syzygy/block_graph/transforms/iterative_transform.h"
+#include "syzygy/block_graph/transforms/named_transform.h"
+#include "syzygy/grinder/basic_block_util.h"
+
+namespace optimize {
+namespace transforms {
+
+// An iterative block transformation that aligns the hot code on fetch-line
+// boundaries: the code blocks whose entry is hot, and within the code blocks,
+// the hot basic blocks that are the target of a backward branch, i.e. the
+// loop heads. The cold code is left as is, so that it doesn't get padded.
+// The padding is filled with multi-byte NOPs by the block builder.
+//
+// The basic blocks are matched to the profile through the source ranges of
+// their blocks, so this may be applied after other transforms that rebuilt
+// the blocks, such as the BasicBlockReorderingTransform. It should be applied
+// after them as the alignment of the basic blocks is lost when a block gets
+// decomposed again.
+class HotCodeAlignmentTransform
+    : public block_graph::transforms::IterativeTransformImpl<
+          HotCodeAlignmentTransform>,
+      public block_graph::transforms::NamedBasicBlockSubGraphTransformImpl<
+          HotCodeAlignmentTransform> {
+ public:
+  typedef block_graph::BasicBlockSubGraph BasicBlockSubGraph;
+  typedef block_graph::BlockGraph BlockGraph;
+  typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
+  typedef grinder::basic_block_util::EntryCountType EntryCountType;
+  typedef grinder::basic_block_util::IndexedFrequencyMap IndexedFrequencyMap;
+  typedef grinder::basic_block_util::RelativeAddress RelativeAddress;
+
+  // The default alignment of the hot code.
+  static const size_t kDefaultAlignment = 16;
+
+  // By default, a basic block is hot if it's been entered at least once for
+  // every this many entries of the hottest basic block of the image.
+  static const EntryCountType kDefaultHotEntryCountRatio = 1000;
+
+  // Initializes a new HotCodeAlignmentTransform instance.
+  // @param frequencies The basic-block frequencies of the image, keyed by the
+  //     address of the basic blocks in the original image. This must outlive
+  //     the transform.
+  explicit HotCodeAlignmentTransform(const IndexedFrequencyMap* frequencies);
+
+  // @name Accessors.
+  // @{
+  size_t alignment() const { return alignment_; }
+  void set_alignment(size_t alignment);
+  EntryCountType hot_entry_count() const { return hot_entry_count_; }
+  void set_hot_entry_count(EntryCountType count);
+  // @}
+
+  // @name Statistics, valid after the transform has been applied.
+  // @{
+  size_t aligned_function_count() const { return aligned_function_count_; }
+  size_t aligned_loop_count() const { return aligned_loop_count_; }
+  // @returns the maximum number of padding bytes the alignments may cost.
+  size_t max_padding_size() const { return max_padding_size_; }
+  // @}
+
+  // The transform name.
+  static const char kTransformName[];
+
+ protected:
+  friend IterativeTransformImpl<HotCodeAlignmentTransform>;
+
+  // @name IterativeTransformImpl implementation.
+  // @{
+  bool OnBlock(const TransformPolicyInterface* policy,
+               BlockGraph* block_graph,
+               BlockGraph::Block* block);
+  bool PostBlockGraphIteration(const TransformPolicyInterface* policy,
+                               BlockGraph* block_graph,
+                               BlockGraph::Block* header_block);
+  // @}
+
+  // @name BasicBlockSubGraphTransformInterface implementation.
+  // @{
+  virtual bool TransformBasicBlockSubGraph(
+      const TransformPolicyInterface* policy,
+      BlockGraph* block_graph,
+      BasicBlockSubGraph* basic_block_subgraph) OVERRIDE;
+  // @}
+
+  // The profiled basic-block frequencies.
+  const IndexedFrequencyMap* frequencies_;
+
+  // The alignment of the hot code.
+  size_t alignment_;
+
+  // The entry count from which a basic block is considered hot.
+  EntryCountType hot_entry_count_;
+
+  // The statistics.
+  size_t aligned_function_count_;
+  size_t aligned_loop_count_;
+  size_t max_padding_size_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(HotCodeAlignmentTransform);
+};
+
+}  // namespace transforms
+}  // namespace optimize
+
+#endif  // SYZYGY_OPTIMIZE_TRANSFORMS_HOT_CODE_ALIGNMENT_TRANSFORM_H_
@@ -0,0 +1,142 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/optimize/transforms/hot_code_alignment_transform.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/block_builder.h"
+#include "syzygy/optimize/unittest_util.h"
+
+namespace optimize {
+namespace transforms {
+
+namespace {
+
+using block_graph::BlockBuilder;
+
+class TestHotCodeAlignmentTransform : public HotCodeAlignmentTransform {
+ public:
+  explicit TestHotCodeAlignmentTransform(
+      const IndexedFrequencyMap* frequencies)
+      : HotCodeAlignmentTransform(frequencies) {
+  }
+
+  using HotCodeAlignmentTransform::TransformBasicBlockSubGraph;
+};
+
+class HotCodeAlignmentTransformTest : public testing::BasicBlockFrequencyTest {
+ public:
+  // Makes the entry and the loop of case_0 hot, and case_1 lukewarm. The
+  // padding basic blocks are never executed.
+  void SetEntryCounts() {
+    SetEntryCount(0, 10);
+    SetEntryCount(2, 5);
+    SetEntryCount(3, 5000);
+    SetEntryCount(4, 5);
+    SetEntryCount(5, 1);
+    SetEntryCount(6, 1);
+  }
+
+  // Remembers the alignments of the basic blocks, before the transform.
+  void SaveAlignments() {
+    alignments_.clear();
+    for (size_t i = 0; i < bbs_.size(); ++i)
+      alignments_.push_back(bbs_[i]->alignment());
+  }
+
+  std::vector<size_t> alignments_;
+};
+
+}  // namespace
+
+TEST_F(HotCodeAlignmentTransformTest, Accessors) {
+  frequencies_[std::make_pair(RelativeAddress(0x1000), 0U)] = 5000;
+  frequencies_[std::make_pair(RelativeAddress(0x2000), 0U)] = 2;
+  // The other columns don't hold entry counts.
+  frequencies_[std::make_pair(RelativeAddress(0x2000), 1U)] = 100000;
+
+  HotCodeAlignmentTransform transform(&frequencies_);
+  EXPECT_EQ(HotCodeAlignmentTransform::kDefaultAlignment,
+            transform.alignment());
+  EXPECT_EQ(5, transform.hot_entry_count());
+
+  transform.set_alignment(32);
+  EXPECT_EQ(32U, transform.alignment());
+  transform.set_hot_entry_count(7);
+  EXPECT_EQ(7, transform.hot_entry_count());
+
+  // There's always a minimum of one entry for the code to be hot.
+  IndexedFrequencyMap empty_frequencies;
+  HotCodeAlignmentTransform empty_transform(&empty_frequencies);
+  EXPECT_EQ(1, empty_transform.hot_entry_count());
+}
+
+TEST_F(HotCodeAlignmentTransformTest, AlignsHotCode) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+  ASSERT_NO_FATAL_FAILURE(InitBasicBlockSubGraph());
+  ASSERT_EQ(kNumBasicBlocks, bbs_.size());
+  ASSERT_EQ(1U, bds_.size());
+  SetEntryCounts();
+  SaveAlignments();
+
+  TestHotCodeAlignmentTransform transform(&frequencies_);
+  ASSERT_EQ(5, transform.hot_entry_count());
+  ASSERT_TRUE(transform.TransformBasicBlockSubGraph(
+      &policy_, &block_graph_, &subgraph_));
+
+  // The entry and the loop head get aligned, not the rest of the code.
+  EXPECT_EQ(HotCodeAlignmentTransform::kDefaultAlignment, bds_[0]->alignment);
+  EXPECT_EQ(HotCodeAlignmentTransform::kDefaultAlignment,
+            bbs_[3]->alignment());
+  for (size_t i = 0; i < kNumBasicBlocks; ++i) {
+    if (i != 3)
+      EXPECT_EQ(alignments_[i], bbs_[i]->alignment()) << "basic block " << i;
+  }
+
+  EXPECT_EQ(1U, transform.aligned_function_count());
+  EXPECT_EQ(1U, transform.aligned_loop_count());
+  EXPECT_LT(0U, transform.max_padding_size());
+
+  // The padded subgraph must still be buildable, and the loop head must land
+  // on an aligned offset.
+  BlockBuilder builder(&block_graph_);
+  ASSERT_TRUE(builder.Merge(&subgraph_));
+  ASSERT_EQ(1U, builder.new_blocks().size());
+  EXPECT_EQ(HotCodeAlignmentTransform::kDefaultAlignment,
+            builder.new_blocks()[0]->alignment());
+}
+
+TEST_F(HotCodeAlignmentTransformTest, LeavesColdLoopsAlone) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+  ASSERT_NO_FATAL_FAILURE(InitBasicBlockSubGraph());
+  SetEntryCounts();
+  SaveAlignments();
+
+  TestHotCodeAlignmentTransform transform(&frequencies_);
+  transform.set_hot_entry_count(10000);
+  ASSERT_TRUE(transform.TransformBasicBlockSubGraph(
+      &policy_, &block_graph_, &subgraph_));
+
+  EXPECT_EQ(assembly_func_->alignment(), bds_[0]->alignment);
+  for (size_t i = 0; i < kNumBasicBlocks; ++i)
+    EXPECT_EQ(alignments_[i], bbs_[i]->alignment()) << "basic block " << i;
+  EXPECT_EQ(0U, transform.aligned_function_count());
+  EXPECT_EQ(0U, transform.aligned_loop_count());
+  EXPECT_EQ(0U, transform.max_padding_size());
+}
+
+}  // namespace transforms
+}  // namespace optimize
@@ -0,0 +1,307 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/optimize/transforms/inlining_transform.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "syzygy/block_graph/basic_block.h"
+#include "syzygy/block_graph/basic_block_decomposer.h"
+#include "syzygy/core/disassembler_util.h"
+#include "syzygy/optimize/transforms/frequency_util.h"
+
+namespace optimize {
+namespace transforms {
+
+namespace {
+
+using block_graph::BasicBlock;
+using block_graph::BasicBlockDecomposer;
+using block_graph::BasicBlockReference;
+using block_graph::BasicCodeBlock;
+using block_graph::BlockGraph;
+using block_graph::Instruction;
+
+typedef InliningTransform::EntryCountType EntryCountType;
+typedef InliningTransform::IndexedFrequencyMap IndexedFrequencyMap;
+
+// @param reg The Distorm index of a register.
+// @returns true if @p reg is the stack or the frame pointer.
+bool IsStackRegister(uint8 reg) {
+  return reg == R_ESP || reg == R_EBP || reg == R_SP || reg == R_BP;
+}
+
+// @param instr An instruction.
+// @returns true if @p instr may be copied out of its function: it doesn't
+//     use the stack, and doesn't alter the control flow.
+bool IsInlinableInstruction(const Instruction& instr) {
+  if (instr.IsControlFlow() || instr.IsInterrupt() || instr.IsSystemCall())
+    return false;
+
+  const _DInst& repr = instr.representation();
+  switch (repr.opcode) {
+    case I_ENTER:
+    case I_LEAVE:
+    case I_POP:
+    case I_POPA:
+    case I_POPF:
+    case I_PUSH:
+    case I_PUSHA:
+    case I_PUSHF:
+      return false;
+  }
+
+  for (size_t i = 0; i < OPERANDS_NO; ++i) {
+    const _Operand& operand = repr.ops[i];
+    switch (operand.type) {
+      case O_REG:
+      case O_SMEM:
+        if (IsStackRegister(operand.index))
+          return false;
+        break;
+      case O_MEM:
+        if (IsStackRegister(operand.index) || IsStackRegister(repr.base))
+          return false;
+        break;
+    }
+  }
+
+  // The references to the callee's own basic blocks can't be carried over.
+  BasicBlock::BasicBlockReferenceMap::const_iterator ref_it =
+      instr.references().begin();
+  for (; ref_it != instr.references().end(); ++ref_it) {
+    if (ref_it->second.referred_type() !=
+            BasicBlockReference::REFERRED_TYPE_BLOCK) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+}  // namespace
+
+const char InliningTransform::kTransformName[] = "InliningTransform";
+const size_t InliningTransform::kMaxInlinedInstructions;
+const size_t InliningTransform::kDefaultMaxCodeGrowth;
+const EntryCountType InliningTransform::kDefaultHotEntryCountRatio;
+
+InliningTransform::InliningTransform(const IndexedFrequencyMap* frequencies)
+    : frequencies_(frequencies),
+      max_code_growth_(kDefaultMaxCodeGrowth),
+      hot_entry_count_(1),
+      inlined_call_count_(0),
+      code_growth_(0) {
+  DCHECK(frequencies != NULL);
+  hot_entry_count_ = std::max<EntryCountType>(
+      1, GetMaxEntryCount(*frequencies) / kDefaultHotEntryCountRatio);
+}
+
+void InliningTransform::set_hot_entry_count(EntryCountType count) {
+  DCHECK_LT(0, count);
+  hot_entry_count_ = count;
+}
+
+bool InliningTransform::OnBlock(const TransformPolicyInterface* policy,
+                                BlockGraph* block_graph,
+                                BlockGraph::Block* block) {
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+  DCHECK(block != NULL);
+
+  if (block->type() != BlockGraph::CODE_BLOCK)
+    return true;
+
+  // Only the blocks calling the start of another code block may contain a
+  // call site to inline.
+  bool calls_code = false;
+  BlockGraph::Block::ReferenceMap::const_iterator ref_it =
+      block->references().begin();
+  for (; ref_it != block->references().end(); ++ref_it) {
+    const BlockGraph::Reference& ref = ref_it->second;
+    if (ref.type() == BlockGraph::PC_RELATIVE_REF &&
+        ref.referenced()->type() == BlockGraph::CODE_BLOCK &&
+        ref.referenced() != block &&
+        ref.offset() == 0) {
+      calls_code = true;
+      break;
+    }
+  }
+  if (!calls_code || !HasHotCode(*frequencies_, block, hot_entry_count_))
+    return true;
+
+  if (!policy->CodeBlockIsSafeToBasicBlockDecompose(block))
+    return true;
+
+  if (!ApplyBasicBlockSubGraphTransform(this, policy, block_graph, block, NULL))
+    return false;
+
+  return true;
+}
+
+bool InliningTransform::PostBlockGraphIteration(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockGraph::Block* header_block) {
+  LOG(INFO) << "Inlined " << inlined_call_count_ << " hot call sites, for "
+            << code_growth_ << " bytes of code growth.";
+  return true;
+}
+
+bool InliningTransform::TransformBasicBlockSubGraph(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BasicBlockSubGraph* basic_block_subgraph) {
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+  DCHECK(basic_block_subgraph != NULL);
+
+  const BlockGraph::Block* original_block =
+      basic_block_subgraph->original_block();
+  DCHECK(original_block != NULL);
+
+  BasicBlockSubGraph::BBCollection::iterator bb_it =
+      basic_block_subgraph->basic_blocks().begin();
+  for (; bb_it != basic_block_subgraph->basic_blocks().end(); ++bb_it) {
+    BasicCodeBlock* bb = BasicCodeBlock::Cast(*bb_it);
+    if (bb == NULL || bb->offset() == BasicBlock::kNoOffset)
+      continue;
+    if (GetEntryCount(*frequencies_, original_block, bb->offset()) <
+            hot_entry_count_) {
+      continue;
+    }
+
+    BasicBlock::Instructions& instructions = bb->instructions();
+    BasicBlock::Instructions::iterator instr_it = instructions.begin();
+    while (instr_it != instructions.end()) {
+      const BlockGraph::Block* callee = NULL;
+      if (instr_it->IsCall() && !instr_it->has_label())
+        callee = GetCallee(*instr_it);
+
+      BasicBlock::Instructions body;
+      if (callee == NULL ||
+          callee == original_block ||
+          !GetInlineBody(policy, callee, &body)) {
+        ++instr_it;
+        continue;
+      }
+
+      // Enforce the code growth budget.
+      size_t body_size = 0;
+      BasicBlock::Instructions::const_iterator body_it = body.begin();
+      for (; body_it != body.end(); ++body_it)
+        body_size += body_it->size();
+      size_t growth = 0;
+      if (body_size > instr_it->size())
+        growth = body_size - instr_it->size();
+      if (code_growth_ + growth > max_code_growth_) {
+        ++instr_it;
+        continue;
+      }
+
+      // Replace the call with the body of the callee.
+      instructions.splice(instr_it, body);
+      instr_it = instructions.erase(instr_it);
+      code_growth_ += growth;
+      ++inlined_call_count_;
+    }
+  }
+
+  return true;
+}
+
+const BlockGraph::Block* InliningTransform::GetCallee(
+    const Instruction& call) {
+  DCHECK(call.IsCall());
+
+  // Only the direct calls go through a PC-relative operand.
+  if (call.representation().ops[0].type != O_PC)
+    return NULL;
+  if (call.references().size() != 1)
+    return NULL;
+
+  const BasicBlockReference& ref = call.references().begin()->second;
+  if (ref.referred_type() != BasicBlockReference::REFERRED_TYPE_BLOCK)
+    return NULL;
+  if (ref.offset() != 0 || ref.base() != 0)
+    return NULL;
+  if (ref.block()->type() != BlockGraph::CODE_BLOCK)
+    return NULL;
+
+  return ref.block();
+}
+
+bool InliningTransform::GetInlineBody(const TransformPolicyInterface* policy,
+                                      const BlockGraph::Block* callee,
+                                      BasicBlock::Instructions* body) {
+  DCHECK(policy != NULL);
+  DCHECK(callee != NULL);
+  DCHECK(body != NULL);
+
+  if (rejected_callees_.count(callee) != 0)
+    return false;
+
+  // The callees are decomposed anew for each site rather than cached, as
+  // their references may point to blocks which get rebuilt in the meantime.
+  bool inlinable = false;
+  do {
+    if ((callee->attributes() & BlockGraph::HAS_EXCEPTION_HANDLING) != 0)
+      break;
+    if (!policy->CodeBlockIsSafeToBasicBlockDecompose(callee))
+      break;
+
+    BasicBlockSubGraph subgraph;
+    BasicBlockDecomposer decomposer(callee, &subgraph);
+    if (!decomposer.Decompose())
+      break;
+
+    // A leaf function is a single basic block ending with a plain return.
+    if (subgraph.basic_blocks().size() != 1)
+      break;
+    BasicCodeBlock* bb = BasicCodeBlock::Cast(*subgraph.basic_blocks().begin());
+    if (bb == NULL || !bb->successors().empty())
+      break;
+    BasicBlock::Instructions& instructions = bb->instructions();
+    if (instructions.empty() ||
+        instructions.size() > kMaxInlinedInstructions + 1) {
+      break;
+    }
+    BasicBlock::Instructions::iterator ret_it = instructions.end();
+    --ret_it;
+    if (!ret_it->IsReturn() || ret_it->representation().ops[0].type != O_NONE)
+      break;
+
+    BasicBlock::Instructions::iterator instr_it = instructions.begin();
+    for (; instr_it != ret_it; ++instr_it) {
+      if (!IsInlinableInstruction(*instr_it))
+        break;
+    }
+    if (instr_it != ret_it)
+      break;
+
+    // The labels stay with the callee.
+    body->assign(instructions.begin(), ret_it);
+    for (instr_it = body->begin(); instr_it != body->end(); ++instr_it)
+      instr_it->set_label(BlockGraph::Label());
+    inlinable = true;
+  } while (false);
+
+  if (!inlinable)
+    rejected_callees_.insert(callee);
+  return inlinable;
+}
+
+}  // namespace transforms
+}  // namespace optimize
@@ -0,0 +1,151 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the inlining transform, which copies tiny leaf functions in place
+// of their hot call sites.
+
+#ifndef SYZYGY_OPTIMIZE_TRANSFORMS_INLINING_TRANSFORM_H_
+#define SYZYGY_OPTIMIZE_TRANSFORMS_INLINING_TRANSFORM_H_
+
+#include <set>
+
+#include "syzygy/block_graph/transforms/iterative_transform.h"
+#include "syzygy/block_graph/transforms/named_transform.h"
+#include "syzygy/grinder/basic_block_util.h"
+
+namespace optimize {
+namespace transforms {
+
+// An iterative block transformation that inlines the tiny leaf functions at
+// their hot call sites. A callee is inlined when:
+// - it's a single basic block of at most kMaxInlinedInstructions
+//   instructions, ending in a plain return;
+// - it doesn't touch the stack or frame pointers, so that it doesn't care
+//   about the missing return address, and doesn't push or pop anything;
+// - it has no exception handling and no other control flow;
+// - it's safe to decompose according to the policy.
+// The call sites are hot when the basic block containing them has been
+// entered at least hot_entry_count() times. The growth of the image is bounded
+// by max_code_growth() bytes; sites where the body is no larger than the call
+// itself are always inlined.
+class InliningTransform
+    : public block_graph::transforms::IterativeTransformImpl<
+          InliningTransform>,
+      public block_graph::transforms::NamedBasicBlockSubGraphTransformImpl<
+          InliningTransform> {
+ public:
+  typedef block_graph::BasicBlock BasicBlock;
+  typedef block_graph::BasicBlockSubGraph BasicBlockSubGraph;
+  typedef block_graph::BlockGraph BlockGraph;
+  typedef block_graph::Instruction Instruction;
+  typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
+  typedef grinder::basic_block_util::EntryCountType EntryCountType;
+  typedef grinder::basic_block_util::IndexedFrequencyMap IndexedFrequencyMap;
+  typedef grinder::basic_block_util::RelativeAddress RelativeAddress;
+
+  // The largest number of instructions of an inlined body, return excluded.
+  static const size_t kMaxInlinedInstructions = 8;
+
+  // By default, the image may grow by at most this many bytes.
+  static const size_t kDefaultMaxCodeGrowth = 4096;
+
+  // By default, a call site is hot if it's been executed at least once for
+  // every this many entries of the hottest basic block of the image.
+  static const EntryCountType kDefaultHotEntryCountRatio = 1000;
+
+  // Initializes a new InliningTransform instance.
+  // @param frequencies The basic-block frequencies of the image, keyed by the
+  //     address of the basic blocks in the original image. This must outlive
+  //     the transform.
+  explicit InliningTransform(const IndexedFrequencyMap* frequencies);
+
+  // @name Accessors.
+  // @{
+  size_t max_code_growth() const { return max_code_growth_; }
+  void set_max_code_growth(size_t max_code_growth) {
+    max_code_growth_ = max_code_growth;
+  }
+  EntryCountType hot_entry_count() const { return hot_entry_count_; }
+  void set_hot_entry_count(EntryCountType count);
+  // @}
+
+  // @name Statistics, valid after the transform has been applied.
+  // @{
+  size_t inlined_call_count() const { return inlined_call_count_; }
+  size_t code_growth() const { return code_growth_; }
+  // @}
+
+  // The transform name.
+  static const char kTransformName[];
+
+ protected:
+  friend IterativeTransformImpl<InliningTransform>;
+
+  // @name IterativeTransformImpl implementation.
+  // @{
+  bool OnBlock(const TransformPolicyInterface* policy,
+               BlockGraph* block_graph,
+               BlockGraph::Block* block);
+  bool PostBlockGraphIteration(const TransformPolicyInterface* policy,
+                               BlockGraph* block_graph,
+                               BlockGraph::Block* header_block);
+  // @}
+
+  // @name BasicBlockSubGraphTransformInterface implementation.
+  // @{
+  virtual bool TransformBasicBlockSubGraph(
+      const TransformPolicyInterface* policy,
+      BlockGraph* block_graph,
+      BasicBlockSubGraph* basic_block_subgraph) OVERRIDE;
+  // @}
+
+  // @param call A call instruction.
+  // @returns the block called by @p call if it's a direct call to the start
+  //     of a block, NULL otherwise.
+  static const BlockGraph::Block* GetCallee(const Instruction& call);
+
+  // Gets the body to inline of a callee.
+  // @param policy The policy object restricting how the callee may be
+  //     decomposed.
+  // @param callee The called block.
+  // @param body Receives the instructions of @p callee, its return excluded.
+  // @returns true if @p callee may be inlined, false otherwise.
+  bool GetInlineBody(const TransformPolicyInterface* policy,
+                     const BlockGraph::Block* callee,
+                     BasicBlock::Instructions* body);
+
+  // The profiled basic-block frequencies.
+  const IndexedFrequencyMap* frequencies_;
+
+  // The code growth budget, in bytes.
+  size_t max_code_growth_;
+
+  // The entry count from which a call site is considered hot.
+  EntryCountType hot_entry_count_;
+
+  // The callees which were found not to be inlinable.
+  std::set<const BlockGraph::Block*> rejected_callees_;
+
+  // The statistics.
+  size_t inlined_call_count_;
+  size_t code_growth_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(InliningTransform);
+};
+
+}  // namespace transforms
+}  // namespace optimize
+
+#endif  // SYZYGY_OPTIMIZE_TRANSFORMS_INLINING_TRANSFORM_H_
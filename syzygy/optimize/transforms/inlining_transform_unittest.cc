@@ -0,0 +1,130 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/optimize/transforms/inlining_transform.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/optimize/unittest_util.h"
+
+namespace optimize {
+namespace transforms {
+
+namespace {
+
+// mov eax, ecx; ret.
+const uint8 kAccessor[] = { 0x8B, 0xC1, 0xC3 };
+// mov eax, 0x12345678; mov ecx, eax; ret.
+const uint8 kLargeAccessor[] = { 0xB8, 0x78, 0x56, 0x34, 0x12, 0x8B, 0xC8,
+                                 0xC3 };
+// mov eax, [esp + 4]; ret.
+const uint8 kStackAccessor[] = { 0x8B, 0x44, 0x24, 0x04, 0xC3 };
+// push ecx; pop eax; ret.
+const uint8 kPushPop[] = { 0x51, 0x58, 0xC3 };
+// mov eax, ecx; ret 4.
+const uint8 kCalleeCleanup[] = { 0x8B, 0xC1, 0xC2, 0x04, 0x00 };
+
+class TestInliningTransform : public InliningTransform {
+ public:
+  explicit TestInliningTransform(const IndexedFrequencyMap* frequencies)
+      : InliningTransform(frequencies) {
+  }
+
+  using InliningTransform::GetInlineBody;
+  using InliningTransform::TransformBasicBlockSubGraph;
+};
+
+class InliningTransformTest : public testing::BasicBlockFrequencyTest {
+ public:
+  // Initializes assembly_func_ with func1_ containing @p code, and makes the
+  // call to func1_ hot.
+  void Init(const uint8* code, size_t size) {
+    ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+    func1_->set_size(size);
+    func1_->CopyData(size, code);
+    ASSERT_NO_FATAL_FAILURE(InitBasicBlockSubGraph());
+
+    // BB5 is the call to func1.
+    ASSERT_EQ(1U, bbs_[5]->instructions().size());
+    ASSERT_TRUE(bbs_[5]->instructions().front().IsCall());
+    SetEntryCount(5, 100);
+  }
+
+  // @returns true if the call of BB5 got inlined by @p transform.
+  bool Inline(TestInliningTransform* transform) {
+    EXPECT_TRUE(transform->TransformBasicBlockSubGraph(
+        &policy_, &block_graph_, &subgraph_));
+    return !bbs_[5]->instructions().front().IsCall();
+  }
+
+  // @returns true if func1_ is inlinable once it contains @p code.
+  bool IsInlinable(const uint8* code, size_t size) {
+    func1_->set_size(size);
+    func1_->CopyData(size, code);
+    BasicBlock::Instructions body;
+    TestInliningTransform transform(&frequencies_);
+    return transform.GetInlineBody(&policy_, func1_, &body);
+  }
+};
+
+}  // namespace
+
+TEST_F(InliningTransformTest, InlinesHotAccessor) {
+  ASSERT_NO_FATAL_FAILURE(Init(kAccessor, sizeof(kAccessor)));
+
+  TestInliningTransform transform(&frequencies_);
+  ASSERT_TRUE(Inline(&transform));
+
+  // The call is replaced with the body of the accessor, which is smaller.
+  ASSERT_EQ(1U, bbs_[5]->instructions().size());
+  EXPECT_EQ(I_MOV, bbs_[5]->instructions().front().representation().opcode);
+  EXPECT_EQ(1U, transform.inlined_call_count());
+  EXPECT_EQ(0U, transform.code_growth());
+}
+
+TEST_F(InliningTransformTest, LeavesColdCallSites) {
+  ASSERT_NO_FATAL_FAILURE(Init(kAccessor, sizeof(kAccessor)));
+
+  TestInliningTransform transform(&frequencies_);
+  transform.set_hot_entry_count(1000);
+  EXPECT_FALSE(Inline(&transform));
+  EXPECT_EQ(0U, transform.inlined_call_count());
+}
+
+TEST_F(InliningTransformTest, EnforcesCodeGrowthBudget) {
+  ASSERT_NO_FATAL_FAILURE(Init(kLargeAccessor, sizeof(kLargeAccessor)));
+
+  TestInliningTransform transform(&frequencies_);
+  transform.set_max_code_growth(1);
+  EXPECT_FALSE(Inline(&transform));
+
+  transform.set_max_code_growth(2);
+  ASSERT_TRUE(Inline(&transform));
+  EXPECT_EQ(2U, bbs_[5]->instructions().size());
+  EXPECT_EQ(2U, transform.code_growth());
+}
+
+TEST_F(InliningTransformTest, RejectsUnsafeCallees) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+
+  EXPECT_TRUE(IsInlinable(kAccessor, sizeof(kAccessor)));
+  EXPECT_FALSE(IsInlinable(kStackAccessor, sizeof(kStackAccessor)));
+  EXPECT_FALSE(IsInlinable(kPushPop, sizeof(kPushPop)));
+  EXPECT_FALSE(IsInlinable(kCalleeCleanup, sizeof(kCalleeCleanup)));
+
+  func1_->set_attributes(BlockGraph::HAS_EXCEPTION_HANDLING);
+  EXPECT_FALSE(IsInlinable(kAccessor, sizeof(kAccessor)));
+}
+
+}  // namespace transforms
+}  // namespace optimize
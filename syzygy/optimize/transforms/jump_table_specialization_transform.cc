@@ -0,0 +1,317 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/optimize/transforms/jump_table_specialization_transform.h"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "base/logging.h"
+#include "syzygy/block_graph/basic_block.h"
+#include "syzygy/block_graph/basic_block_assembler.h"
+#include "syzygy/core/disassembler_util.h"
+#include "syzygy/optimize/transforms/frequency_util.h"
+
+namespace optimize {
+namespace transforms {
+
+namespace {
+
+using block_graph::BasicBlock;
+using block_graph::BasicBlockAssembler;
+using block_graph::BasicBlockReference;
+using block_graph::BasicBlockSubGraph;
+using block_graph::BasicCodeBlock;
+using block_graph::BasicDataBlock;
+using block_graph::BlockGraph;
+using block_graph::Immediate;
+using block_graph::Instruction;
+using block_graph::Successor;
+
+typedef JumpTableSpecializationTransform::EntryCountType EntryCountType;
+typedef JumpTableSpecializationTransform::IndexedFrequencyMap
+    IndexedFrequencyMap;
+
+// A case of a jump table.
+struct CaseInfo {
+  EntryCountType count;
+  size_t index;
+  BasicCodeBlock* target;
+};
+
+// Orders the cases by decreasing frequency, then by index.
+bool IsMoreFrequent(const CaseInfo& case1, const CaseInfo& case2) {
+  if (case1.count != case2.count)
+    return case1.count > case2.count;
+  return case1.index < case2.index;
+}
+
+// @param index The Distorm index of a register.
+// @returns the general purpose 32-bit register @p index, or NULL.
+const core::Register32* GetRegister32(uint8 index) {
+  for (size_t i = 0; i < core::kRegister32Count; ++i) {
+    const core::Register32& reg = core::kRegisters32[i];
+    if (core::GetRegisterType(reg) == index)
+      return &reg;
+  }
+  return NULL;
+}
+
+// Lays out @p new_bbs right after @p bb.
+void InsertAfter(BasicBlock* bb,
+                 const std::vector<BasicBlock*>& new_bbs,
+                 BasicBlockSubGraph* subgraph) {
+  BasicBlockSubGraph::BlockDescriptionList::iterator desc_it =
+      subgraph->block_descriptions().begin();
+  for (; desc_it != subgraph->block_descriptions().end(); ++desc_it) {
+    BasicBlockSubGraph::BasicBlockOrdering& order =
+        desc_it->basic_block_order;
+    BasicBlockSubGraph::BasicBlockOrdering::iterator bb_it =
+        std::find(order.begin(), order.end(), bb);
+    if (bb_it == order.end())
+      continue;
+    ++bb_it;
+    order.insert(bb_it, new_bbs.begin(), new_bbs.end());
+    return;
+  }
+  NOTREACHED();
+}
+
+}  // namespace
+
+const char JumpTableSpecializationTransform::kTransformName[] =
+    "JumpTableSpecializationTransform";
+const size_t JumpTableSpecializationTransform::kMaxSpecializedCases;
+const size_t JumpTableSpecializationTransform::kMinCasePercentage;
+const EntryCountType
+    JumpTableSpecializationTransform::kDefaultHotEntryCountRatio;
+
+JumpTableSpecializationTransform::JumpTableSpecializationTransform(
+    const IndexedFrequencyMap* frequencies)
+    : frequencies_(frequencies),
+      hot_entry_count_(1),
+      specialized_switch_count_(0),
+      specialized_case_count_(0) {
+  DCHECK(frequencies != NULL);
+  hot_entry_count_ = std::max<EntryCountType>(
+      1, GetMaxEntryCount(*frequencies) / kDefaultHotEntryCountRatio);
+}
+
+void JumpTableSpecializationTransform::set_hot_entry_count(
+    EntryCountType count) {
+  DCHECK_LT(0, count);
+  hot_entry_count_ = count;
+}
+
+bool JumpTableSpecializationTransform::OnBlock(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockGraph::Block* block) {
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+  DCHECK(block != NULL);
+
+  if (block->type() != BlockGraph::CODE_BLOCK)
+    return true;
+
+  // Only the blocks with a jump table need to be looked at.
+  bool has_jump_table = false;
+  BlockGraph::Block::LabelMap::const_iterator label_it =
+      block->labels().begin();
+  for (; label_it != block->labels().end(); ++label_it) {
+    if (label_it->second.has_attributes(BlockGraph::JUMP_TABLE_LABEL)) {
+      has_jump_table = true;
+      break;
+    }
+  }
+  if (!has_jump_table)
+    return true;
+
+  if (!policy->CodeBlockIsSafeToBasicBlockDecompose(block))
+    return true;
+
+  if (!ApplyBasicBlockSubGraphTransform(this, policy, block_graph, block, NULL))
+    return false;
+
+  return true;
+}
+
+bool JumpTableSpecializationTransform::PostBlockGraphIteration(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockGraph::Block* header_block) {
+  LOG(INFO) << "Specialized " << specialized_switch_count_
+            << " hot switches, testing " << specialized_case_count_
+            << " cases ahead of their jump tables.";
+  return true;
+}
+
+bool JumpTableSpecializationTransform::TransformBasicBlockSubGraph(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BasicBlockSubGraph* basic_block_subgraph) {
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+  DCHECK(basic_block_subgraph != NULL);
+
+  LivenessAnalysis liveness;
+  liveness.Analyze(basic_block_subgraph);
+
+  // The basic blocks added along the way don't need to be visited, gather
+  // the existing ones first.
+  std::vector<BasicCodeBlock*> bbs;
+  BasicBlockSubGraph::BBCollection::iterator bb_it =
+      basic_block_subgraph->basic_blocks().begin();
+  for (; bb_it != basic_block_subgraph->basic_blocks().end(); ++bb_it) {
+    BasicCodeBlock* bb = BasicCodeBlock::Cast(*bb_it);
+    if (bb != NULL)
+      bbs.push_back(bb);
+  }
+
+  for (size_t i = 0; i < bbs.size(); ++i) {
+    size_t case_count = SpecializeDispatch(liveness, basic_block_subgraph,
+                                           bbs[i]);
+    if (case_count != 0) {
+      ++specialized_switch_count_;
+      specialized_case_count_ += case_count;
+    }
+  }
+
+  return true;
+}
+
+size_t JumpTableSpecializationTransform::SpecializeDispatch(
+    const LivenessAnalysis& liveness,
+    BasicBlockSubGraph* subgraph,
+    BasicCodeBlock* bb) {
+  DCHECK(subgraph != NULL);
+  DCHECK(bb != NULL);
+
+  const BlockGraph::Block* original_block = subgraph->original_block();
+  if (original_block == NULL || bb->offset() == BasicBlock::kNoOffset)
+    return 0;
+  EntryCountType dispatch_count =
+      GetEntryCount(*frequencies_, original_block, bb->offset());
+  if (dispatch_count < hot_entry_count_)
+    return 0;
+
+  // Look for a jump through a table indexed by a register:
+  // jmp [table + reg * 4].
+  if (bb->instructions().empty() || !bb->successors().empty())
+    return 0;
+  const Instruction& jump = bb->instructions().back();
+  const _DInst& repr = jump.representation();
+  if (repr.opcode != I_JMP || repr.ops[0].type != O_MEM ||
+      repr.scale != 4 || repr.base != R_NONE) {
+    return 0;
+  }
+  const core::Register32* index_reg = GetRegister32(repr.ops[0].index);
+  if (index_reg == NULL || jump.references().size() != 1)
+    return 0;
+  const BasicBlockReference& table_ref = jump.references().begin()->second;
+  BasicDataBlock* table = BasicDataBlock::Cast(table_ref.basic_block());
+  if (table == NULL || table_ref.offset() != 0)
+    return 0;
+
+  // Gather the indices leading to each target of the table.
+  typedef std::map<BasicCodeBlock*, std::vector<size_t> > TargetMap;
+  TargetMap targets;
+  BasicBlock::BasicBlockReferenceMap::const_iterator ref_it =
+      table->references().begin();
+  for (; ref_it != table->references().end(); ++ref_it) {
+    BasicCodeBlock* target =
+        BasicCodeBlock::Cast(ref_it->second.basic_block());
+    if (target == NULL || ref_it->first % sizeof(uint32) != 0)
+      return 0;
+    targets[target].push_back(ref_it->first / sizeof(uint32));
+  }
+
+  // The comparisons clobber the flags, which must not be used by any target.
+  TargetMap::const_iterator target_it = targets.begin();
+  for (; target_it != targets.end(); ++target_it) {
+    LivenessAnalysis::State state;
+    liveness.GetStateAtEntryOf(target_it->first, &state);
+    if (state.AreArithmeticFlagsLive())
+      return 0;
+  }
+
+  // Pick the dominant cases. Only the targets reached through a single
+  // entry of the table can be tested with a single comparison.
+  std::vector<CaseInfo> cases;
+  for (target_it = targets.begin(); target_it != targets.end(); ++target_it) {
+    BasicCodeBlock* target = target_it->first;
+    if (target_it->second.size() != 1 ||
+        target->offset() == BasicBlock::kNoOffset) {
+      continue;
+    }
+    CaseInfo info = {
+        GetEntryCount(*frequencies_, original_block, target->offset()),
+        target_it->second.front(),
+        target };
+    if (static_cast<size_t>(info.count) * 100 <
+            static_cast<size_t>(dispatch_count) * kMinCasePercentage) {
+      continue;
+    }
+    cases.push_back(info);
+  }
+  std::sort(cases.begin(), cases.end(), &IsMoreFrequent);
+  if (cases.size() > kMaxSpecializedCases)
+    cases.resize(kMaxSpecializedCases);
+  if (cases.empty())
+    return 0;
+
+  // Move the jump to a basic block of its own.
+  BasicCodeBlock* dispatch_bb =
+      subgraph->AddBasicCodeBlock(bb->name() + ".dispatch");
+  BasicBlock::Instructions::iterator jump_it = bb->instructions().end();
+  --jump_it;
+  dispatch_bb->instructions().splice(dispatch_bb->instructions().end(),
+                                     bb->instructions(),
+                                     jump_it);
+
+  // Chain the tests of the dominant cases ahead of it.
+  std::vector<BasicBlock*> new_bbs;
+  BasicCodeBlock* test_bb = bb;
+  for (size_t i = 0; i < cases.size(); ++i) {
+    BasicCodeBlock* next_bb = dispatch_bb;
+    if (i + 1 < cases.size())
+      next_bb = subgraph->AddBasicCodeBlock(bb->name() + ".case");
+
+    BasicBlockAssembler assm(test_bb->instructions().end(),
+                             &test_bb->instructions());
+    assm.cmp(*index_reg, Immediate(cases[i].index, core::kSize32Bit));
+    test_bb->successors().push_back(
+        Successor(Successor::kConditionEqual,
+                  BasicBlockReference(BlockGraph::PC_RELATIVE_REF,
+                                      BlockGraph::Reference::kMaximumSize,
+                                      cases[i].target),
+                  0));
+    test_bb->successors().push_back(
+        Successor(Successor::kConditionNotEqual,
+                  BasicBlockReference(BlockGraph::PC_RELATIVE_REF,
+                                      BlockGraph::Reference::kMaximumSize,
+                                      next_bb),
+                  0));
+
+    new_bbs.push_back(next_bb);
+    test_bb = next_bb;
+  }
+  InsertAfter(bb, new_bbs, subgraph);
+
+  return cases.size();
+}
+
+}  // namespace transforms
+}  // namespace optimize
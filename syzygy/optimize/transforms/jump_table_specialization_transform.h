@@ -0,0 +1,140 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the jump table specialization transform, which tests the dominant
+// cases of the skewed switches before their indirect jump.
+
+#ifndef SYZYGY_OPTIMIZE_TRANSFORMS_JUMP_TABLE_SPECIALIZATION_TRANSFORM_H_
+#define SYZYGY_OPTIMIZE_TRANSFORMS_JUMP_TABLE_SPECIALIZATION_TRANSFORM_H_
+
+#include "syzygy/block_graph/analysis/liveness_analysis.h"
+#include "syzygy/block_graph/transforms/iterative_transform.h"
+#include "syzygy/block_graph/transforms/named_transform.h"
+#include "syzygy/grinder/basic_block_util.h"
+
+namespace optimize {
+namespace transforms {
+
+// An iterative block transformation that specializes the dispatch of the hot
+// switches whose case frequencies are skewed. The cases which are taken most
+// of the time get tested with a compare-and-branch before the indirect jump
+// through the jump table, which then only handles the remaining cases:
+//
+//     jmp [table + eax * 4]     =>    cmp eax, 3
+//                                     je case_3
+//                                     jmp [table + eax * 4]
+//
+// The frequency of a case is the entry count of its target basic block. The
+// dispatch is only rewritten when the liveness analysis proves that the flags
+// are dead on entry of every target of the jump table, as the comparisons
+// clobber them.
+class JumpTableSpecializationTransform
+    : public block_graph::transforms::IterativeTransformImpl<
+          JumpTableSpecializationTransform>,
+      public block_graph::transforms::NamedBasicBlockSubGraphTransformImpl<
+          JumpTableSpecializationTransform> {
+ public:
+  typedef block_graph::BasicBlock BasicBlock;
+  typedef block_graph::BasicBlockSubGraph BasicBlockSubGraph;
+  typedef block_graph::BasicCodeBlock BasicCodeBlock;
+  typedef block_graph::BlockGraph BlockGraph;
+  typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
+  typedef block_graph::analysis::LivenessAnalysis LivenessAnalysis;
+  typedef grinder::basic_block_util::EntryCountType EntryCountType;
+  typedef grinder::basic_block_util::IndexedFrequencyMap IndexedFrequencyMap;
+  typedef grinder::basic_block_util::RelativeAddress RelativeAddress;
+
+  // The largest number of cases tested ahead of the jump, per switch.
+  static const size_t kMaxSpecializedCases = 2;
+
+  // A case gets tested ahead of the jump if it accounts for at least this
+  // percentage of the executions of the switch.
+  static const size_t kMinCasePercentage = 30;
+
+  // By default, a switch is hot if it's been executed at least once for every
+  // this many entries of the hottest basic block of the image.
+  static const EntryCountType kDefaultHotEntryCountRatio = 1000;
+
+  // Initializes a new JumpTableSpecializationTransform instance.
+  // @param frequencies The basic-block frequencies of the image, keyed by the
+  //     address of the basic blocks in the original image. This must outlive
+  //     the transform.
+  explicit JumpTableSpecializationTransform(
+      const IndexedFrequencyMap* frequencies);
+
+  // @name Accessors.
+  // @{
+  EntryCountType hot_entry_count() const { return hot_entry_count_; }
+  void set_hot_entry_count(EntryCountType count);
+  // @}
+
+  // @name Statistics, valid after the transform has been applied.
+  // @{
+  size_t specialized_switch_count() const {
+    return specialized_switch_count_;
+  }
+  size_t specialized_case_count() const { return specialized_case_count_; }
+  // @}
+
+  // The transform name.
+  static const char kTransformName[];
+
+ protected:
+  friend IterativeTransformImpl<JumpTableSpecializationTransform>;
+
+  // @name IterativeTransformImpl implementation.
+  // @{
+  bool OnBlock(const TransformPolicyInterface* policy,
+               BlockGraph* block_graph,
+               BlockGraph::Block* block);
+  bool PostBlockGraphIteration(const TransformPolicyInterface* policy,
+                               BlockGraph* block_graph,
+                               BlockGraph::Block* header_block);
+  // @}
+
+  // @name BasicBlockSubGraphTransformInterface implementation.
+  // @{
+  virtual bool TransformBasicBlockSubGraph(
+      const TransformPolicyInterface* policy,
+      BlockGraph* block_graph,
+      BasicBlockSubGraph* basic_block_subgraph) OVERRIDE;
+  // @}
+
+  // Specializes the dispatch ending a basic block, if it's skewed enough.
+  // @param liveness The global liveness analysis of @p subgraph.
+  // @param subgraph The subgraph containing @p bb.
+  // @param bb A hot basic block.
+  // @returns the number of cases tested ahead of the jump.
+  size_t SpecializeDispatch(const LivenessAnalysis& liveness,
+                            BasicBlockSubGraph* subgraph,
+                            BasicCodeBlock* bb);
+
+  // The profiled basic-block frequencies.
+  const IndexedFrequencyMap* frequencies_;
+
+  // The entry count from which a switch is considered hot.
+  EntryCountType hot_entry_count_;
+
+  // The statistics.
+  size_t specialized_switch_count_;
+  size_t specialized_case_count_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(JumpTableSpecializationTransform);
+};
+
+}  // namespace transforms
+}  // namespace optimize
+
+#endif  // SYZYGY_OPTIMIZE_TRANSFORMS_JUMP_TABLE_SPECIALIZATION_TRANSFORM_H_
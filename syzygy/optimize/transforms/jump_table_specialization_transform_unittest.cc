@@ -0,0 +1,138 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/optimize/transforms/jump_table_specialization_transform.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/basic_block_assembler.h"
+#include "syzygy/block_graph/block_builder.h"
+#include "syzygy/optimize/unittest_util.h"
+
+namespace optimize {
+namespace transforms {
+
+namespace {
+
+using block_graph::BasicBlockAssembler;
+using block_graph::BasicCodeBlock;
+using block_graph::BlockBuilder;
+using block_graph::Immediate;
+using block_graph::Successor;
+
+class TestJumpTableSpecializationTransform
+    : public JumpTableSpecializationTransform {
+ public:
+  explicit TestJumpTableSpecializationTransform(
+      const IndexedFrequencyMap* frequencies)
+      : JumpTableSpecializationTransform(frequencies) {
+  }
+
+  using JumpTableSpecializationTransform::TransformBasicBlockSubGraph;
+};
+
+class JumpTableSpecializationTransformTest
+    : public testing::BasicBlockFrequencyTest {
+ public:
+  // Clobbers the flags at the start of the cases of the jump table, so that
+  // they're dead on entry. The cases begin with calls otherwise, through
+  // which the liveness analysis assumes everything is live.
+  void ClobberFlagsInCases() {
+    BasicCodeBlock* cases[] = { BasicCodeBlock::Cast(bbs_[5]),
+                                BasicCodeBlock::Cast(bbs_[6]) };
+    for (size_t i = 0; i < arraysize(cases); ++i) {
+      BasicBlockAssembler assm(cases[i]->instructions().begin(),
+                               &cases[i]->instructions());
+      assm.cmp(core::ecx, Immediate(0, core::kSize32Bit));
+    }
+  }
+};
+
+}  // namespace
+
+TEST_F(JumpTableSpecializationTransformTest, SpecializesDominantCase) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+  ASSERT_NO_FATAL_FAILURE(InitBasicBlockSubGraph());
+  ASSERT_NO_FATAL_FAILURE(ClobberFlagsInCases());
+
+  // case_0 is taken 90% of the time.
+  SetEntryCount(0, 100);
+  SetEntryCount(2, 90);
+  SetEntryCount(5, 5);
+  SetEntryCount(6, 10);
+
+  TestJumpTableSpecializationTransform transform(&frequencies_);
+  ASSERT_TRUE(transform.TransformBasicBlockSubGraph(
+      &policy_, &block_graph_, &subgraph_));
+  EXPECT_EQ(1U, transform.specialized_switch_count());
+  EXPECT_EQ(1U, transform.specialized_case_count());
+
+  // The dispatch now tests for case_0 before jumping through the table.
+  BasicCodeBlock* dispatch = BasicCodeBlock::Cast(bbs_[0]);
+  ASSERT_EQ(4U, dispatch->instructions().size());
+  EXPECT_EQ(I_CMP, dispatch->instructions().back().representation().opcode);
+  ASSERT_EQ(2U, dispatch->successors().size());
+  EXPECT_EQ(Successor::kConditionEqual,
+            dispatch->successors().front().condition());
+  EXPECT_EQ(bbs_[2],
+            dispatch->successors().front().reference().basic_block());
+
+  // The jump follows right after.
+  BasicBlockSubGraph::BasicBlockOrdering& order = bds_[0]->basic_block_order;
+  ASSERT_EQ(kNumBasicBlocks + 1, order.size());
+  BasicBlockSubGraph::BasicBlockOrdering::iterator it = order.begin();
+  ++it;
+  BasicCodeBlock* jump = BasicCodeBlock::Cast(*it);
+  ASSERT_TRUE(jump != NULL);
+  EXPECT_EQ(jump, dispatch->successors().back().reference().basic_block());
+  ASSERT_EQ(1U, jump->instructions().size());
+  EXPECT_EQ(I_JMP, jump->instructions().front().representation().opcode);
+
+  // The specialized subgraph must still be buildable.
+  BlockBuilder builder(&block_graph_);
+  EXPECT_TRUE(builder.Merge(&subgraph_));
+}
+
+TEST_F(JumpTableSpecializationTransformTest, LeavesBalancedSwitches) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+  ASSERT_NO_FATAL_FAILURE(InitBasicBlockSubGraph());
+  ASSERT_NO_FATAL_FAILURE(ClobberFlagsInCases());
+
+  SetEntryCount(0, 100);
+  SetEntryCount(2, 25);
+  SetEntryCount(5, 25);
+  SetEntryCount(6, 25);
+
+  TestJumpTableSpecializationTransform transform(&frequencies_);
+  ASSERT_TRUE(transform.TransformBasicBlockSubGraph(
+      &policy_, &block_graph_, &subgraph_));
+  EXPECT_EQ(0U, transform.specialized_switch_count());
+  EXPECT_EQ(kNumBasicBlocks, bds_[0]->basic_block_order.size());
+}
+
+TEST_F(JumpTableSpecializationTransformTest, LeavesLiveFlags) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+  ASSERT_NO_FATAL_FAILURE(InitBasicBlockSubGraph());
+
+  // The cases start with calls, the flags may be live on their entry.
+  SetEntryCount(0, 100);
+  SetEntryCount(2, 90);
+
+  TestJumpTableSpecializationTransform transform(&frequencies_);
+  ASSERT_TRUE(transform.TransformBasicBlockSubGraph(
+      &policy_, &block_graph_, &subgraph_));
+  EXPECT_EQ(0U, transform.specialized_switch_count());
+}
+
+}  // namespace transforms
+}  // namespace optimize
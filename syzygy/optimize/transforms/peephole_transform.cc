@@ -0,0 +1,326 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/optimize/transforms/peephole_transform.h"
+
+#include <map>
+
+#include "base/logging.h"
+#include "syzygy/block_graph/basic_block.h"
+#include "syzygy/core/disassembler_util.h"
+
+namespace optimize {
+namespace transforms {
+
+namespace {
+
+using block_graph::BasicBlock;
+using block_graph::BasicBlockReference;
+using block_graph::BasicCodeBlock;
+using block_graph::Instruction;
+using block_graph::Successor;
+
+typedef block_graph::analysis::LivenessAnalysis LivenessAnalysis;
+
+// @param index The Distorm index of a register.
+// @param state A liveness state.
+// @returns true if @p index is a general purpose 32-bit register which is
+//     proven dead in @p state.
+bool IsDeadRegister32(uint8 index, const LivenessAnalysis::State& state) {
+  for (size_t i = 0; i < core::kRegister32Count; ++i) {
+    const core::Register32& reg = core::kRegisters32[i];
+    if (core::GetRegisterType(reg) == index)
+      return !state.IsLive(reg);
+  }
+  return false;
+}
+
+// @param instr An instruction.
+// @returns true if @p instr moves a register to itself.
+bool IsSelfMove(const Instruction& instr) {
+  const _DInst& repr = instr.representation();
+  return repr.opcode == I_MOV &&
+      repr.ops[0].type == O_REG &&
+      repr.ops[1].type == O_REG &&
+      repr.ops[0].index == repr.ops[1].index;
+}
+
+// @param instr An instruction.
+// @param state The liveness state after @p instr.
+// @returns true if @p instr moves a register or an immediate to a register
+//     which is dead afterwards.
+bool IsDeadMove(const Instruction& instr,
+                const LivenessAnalysis::State& state) {
+  const _DInst& repr = instr.representation();
+  if (repr.opcode != I_MOV || !instr.references().empty())
+    return false;
+  if (repr.ops[0].type != O_REG || repr.ops[0].size != 32)
+    return false;
+  if (repr.ops[1].type != O_REG && repr.ops[1].type != O_IMM)
+    return false;
+  // The stack and frame pointers are never treated as dead.
+  if (repr.ops[0].index == R_ESP || repr.ops[0].index == R_EBP)
+    return false;
+  return IsDeadRegister32(repr.ops[0].index, state);
+}
+
+}  // namespace
+
+const char PeepholeTransform::kTransformName[] = "PeepholeTransform";
+const size_t PeepholeTransform::kMaxInlinedReturnSize;
+const size_t PeepholeTransform::kMaxJumpChainLength;
+
+PeepholeTransform::PeepholeTransform(const IndexedFrequencyMap* frequencies)
+    : frequencies_(frequencies),
+      removed_move_count_(0),
+      folded_jump_count_(0),
+      inlined_return_count_(0) {
+  DCHECK(frequencies != NULL);
+}
+
+bool PeepholeTransform::OnBlock(const TransformPolicyInterface* policy,
+                                BlockGraph* block_graph,
+                                BlockGraph::Block* block) {
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+  DCHECK(block != NULL);
+
+  if (block->type() != BlockGraph::CODE_BLOCK)
+    return true;
+
+  if (!HasHotCode(block))
+    return true;
+
+  if (!policy->CodeBlockIsSafeToBasicBlockDecompose(block))
+    return true;
+
+  if (!ApplyBasicBlockSubGraphTransform(this, policy, block_graph, block, NULL))
+    return false;
+
+  return true;
+}
+
+bool PeepholeTransform::PostBlockGraphIteration(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockGraph::Block* header_block) {
+  LOG(INFO) << "Peephole: removed " << removed_move_count_ << " moves, "
+            << "folded " << folded_jump_count_ << " jumps and inlined "
+            << inlined_return_count_ << " returns.";
+  return true;
+}
+
+bool PeepholeTransform::TransformBasicBlockSubGraph(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BasicBlockSubGraph* basic_block_subgraph) {
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+  DCHECK(basic_block_subgraph != NULL);
+
+  const BlockGraph::Block* original_block =
+      basic_block_subgraph->original_block();
+
+  // The liveness is analyzed before any rewrite. Removing a dead move only
+  // ever shortens live ranges, and the control flow rewrites come after the
+  // moves, so the analysis stays conservative throughout.
+  LivenessAnalysis liveness;
+  liveness.Analyze(basic_block_subgraph);
+
+  // Find the basic block laid out after each basic block.
+  std::map<const BasicBlock*, const BasicBlock*> next_bbs;
+  BasicBlockSubGraph::BlockDescriptionList::const_iterator desc_it =
+      basic_block_subgraph->block_descriptions().begin();
+  for (; desc_it != basic_block_subgraph->block_descriptions().end();
+       ++desc_it) {
+    const BasicBlockSubGraph::BasicBlockOrdering& order =
+        desc_it->basic_block_order;
+    BasicBlockSubGraph::BasicBlockOrdering::const_iterator bb_it =
+        order.begin();
+    for (; bb_it != order.end(); ++bb_it) {
+      BasicBlockSubGraph::BasicBlockOrdering::const_iterator next_it = bb_it;
+      ++next_it;
+      next_bbs[*bb_it] = next_it == order.end() ? NULL : *next_it;
+    }
+  }
+
+  BasicBlockSubGraph::BBCollection::iterator bb_it =
+      basic_block_subgraph->basic_blocks().begin();
+  for (; bb_it != basic_block_subgraph->basic_blocks().end(); ++bb_it) {
+    BasicCodeBlock* bb = BasicCodeBlock::Cast(*bb_it);
+    if (bb == NULL || !IsHot(original_block, bb))
+      continue;
+
+    removed_move_count_ += RemoveRedundantMoves(liveness, bb);
+    folded_jump_count_ += FoldJumpChains(bb);
+    if (InlineReturn(bb, next_bbs[bb]))
+      ++inlined_return_count_;
+  }
+
+  return true;
+}
+
+size_t PeepholeTransform::RemoveRedundantMoves(
+    const LivenessAnalysis& liveness, BasicCodeBlock* bb) {
+  DCHECK(bb != NULL);
+
+  BasicBlock::Instructions& instructions = bb->instructions();
+  if (instructions.empty())
+    return 0;
+
+  LivenessAnalysis::State state;
+  liveness.GetStateAtExitOf(bb, &state);
+
+  size_t removed = 0;
+  BasicBlock::Instructions::iterator instr_it = instructions.end();
+  do {
+    --instr_it;
+
+    // The two-byte move at the entry of a function may be a hot-patching
+    // point, it's left alone.
+    bool is_patch_point = bb->offset() == 0 &&
+        instr_it == instructions.begin();
+
+    if (!is_patch_point && !instr_it->has_label() &&
+        (IsSelfMove(*instr_it) || IsDeadMove(*instr_it, state))) {
+      instr_it = instructions.erase(instr_it);
+      ++removed;
+      continue;
+    }
+
+    LivenessAnalysis::PropagateBackward(*instr_it, &state);
+  } while (instr_it != instructions.begin());
+
+  return removed;
+}
+
+size_t PeepholeTransform::FoldJumpChains(BasicCodeBlock* bb) {
+  DCHECK(bb != NULL);
+
+  size_t folded = 0;
+  BasicBlock::Successors::iterator succ_it = bb->successors().begin();
+  for (; succ_it != bb->successors().end(); ++succ_it) {
+    BasicBlockReference reference = succ_it->reference();
+    BasicBlock* target = reference.basic_block();
+
+    // Follow the basic blocks which do nothing but jump elsewhere.
+    BasicBlock* destination = target;
+    for (size_t i = 0; i < kMaxJumpChainLength; ++i) {
+      BasicCodeBlock* trampoline = BasicCodeBlock::Cast(destination);
+      if (trampoline == NULL ||
+          !trampoline->instructions().empty() ||
+          trampoline->successors().size() != 1) {
+        break;
+      }
+      const Successor& jump = trampoline->successors().front();
+      BasicBlock* next = jump.reference().basic_block();
+      if (jump.condition() != Successor::kConditionTrue ||
+          next == NULL || next == trampoline) {
+        break;
+      }
+      destination = next;
+    }
+
+    if (destination == target)
+      continue;
+
+    succ_it->set_reference(BasicBlockReference(reference.reference_type(),
+                                               reference.size(),
+                                               destination));
+    ++folded;
+  }
+
+  return folded;
+}
+
+bool PeepholeTransform::InlineReturn(BasicCodeBlock* bb,
+                                     const BasicBlock* next_bb) {
+  DCHECK(bb != NULL);
+
+  if (bb->successors().size() != 1)
+    return false;
+  const Successor& jump = bb->successors().front();
+  if (jump.condition() != Successor::kConditionTrue)
+    return false;
+
+  BasicCodeBlock* target = BasicCodeBlock::Cast(jump.reference().basic_block());
+  if (target == NULL || target == next_bb || target == bb)
+    return false;
+  if (!target->successors().empty() || target->instructions().empty())
+    return false;
+  if (!target->instructions().back().IsReturn())
+    return false;
+
+  size_t size = 0;
+  BasicBlock::Instructions::const_iterator instr_it =
+      target->instructions().begin();
+  for (; instr_it != target->instructions().end(); ++instr_it) {
+    if (!instr_it->references().empty())
+      return false;
+    size += instr_it->size();
+  }
+  if (size > kMaxInlinedReturnSize)
+    return false;
+
+  // Copy the epilog in place of the jump. The labels stay with the original.
+  for (instr_it = target->instructions().begin();
+       instr_it != target->instructions().end(); ++instr_it) {
+    Instruction copy(*instr_it);
+    copy.set_label(BlockGraph::Label());
+    bb->instructions().push_back(copy);
+  }
+  bb->successors().clear();
+
+  return true;
+}
+
+bool PeepholeTransform::IsHot(const BlockGraph::Block* block,
+                              const BasicBlock* bb) const {
+  DCHECK(bb != NULL);
+
+  if (block == NULL || bb->offset() == BasicBlock::kNoOffset)
+    return false;
+
+  const BlockGraph::Block::SourceRanges::RangePair* range_pair =
+      block->source_ranges().FindRangePair(bb->offset(), 1);
+  if (range_pair == NULL)
+    return false;
+
+  RelativeAddress address =
+      range_pair->second.start() + (bb->offset() - range_pair->first.start());
+  IndexedFrequencyMap::const_iterator it =
+      frequencies_->find(std::make_pair(address, 0U));
+  return it != frequencies_->end() && it->second > 0;
+}
+
+bool PeepholeTransform::HasHotCode(const BlockGraph::Block* block) const {
+  DCHECK(block != NULL);
+
+  BlockGraph::Block::SourceRanges::RangePairs::const_iterator range_it =
+      block->source_ranges().range_pairs().begin();
+  for (; range_it != block->source_ranges().range_pairs().end(); ++range_it) {
+    RelativeAddress start = range_it->second.start();
+    RelativeAddress end = range_it->second.end();
+    IndexedFrequencyMap::const_iterator it =
+        frequencies_->lower_bound(std::make_pair(start, 0U));
+    for (; it != frequencies_->end() && it->first.first < end; ++it) {
+      if (it->first.second == 0 && it->second > 0)
+        return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace transforms
+}  // namespace optimize
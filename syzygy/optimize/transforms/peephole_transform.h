@@ -0,0 +1,146 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the peephole transform, which applies safe local rewrites to the
+// hot basic blocks of an image.
+
+#ifndef SYZYGY_OPTIMIZE_TRANSFORMS_PEEPHOLE_TRANSFORM_H_
+#define SYZYGY_OPTIMIZE_TRANSFORMS_PEEPHOLE_TRANSFORM_H_
+
+#include "syzygy/block_graph/analysis/liveness_analysis.h"
+#include "syzygy/block_graph/transforms/iterative_transform.h"
+#include "syzygy/block_graph/transforms/named_transform.h"
+#include "syzygy/grinder/basic_block_util.h"
+
+namespace optimize {
+namespace transforms {
+
+// An iterative block transformation that applies peephole rewrites to the
+// basic blocks which were executed according to the profile:
+// - the moves of a register to itself are removed, as are the moves to a
+//   register which is proven dead by the liveness analysis;
+// - the branches to a basic block which only jumps elsewhere are redirected
+//   to the final destination;
+// - the jumps to a tiny basic block which returns are replaced by a copy of
+//   that basic block.
+//
+// Only the blocks which the policy deems safe to decompose are rewritten.
+// This should be applied once the basic blocks have been laid out, as the
+// inlining of the returns depends on the layout.
+class PeepholeTransform
+    : public block_graph::transforms::IterativeTransformImpl<
+          PeepholeTransform>,
+      public block_graph::transforms::NamedBasicBlockSubGraphTransformImpl<
+          PeepholeTransform> {
+ public:
+  typedef block_graph::BasicBlock BasicBlock;
+  typedef block_graph::BasicBlockSubGraph BasicBlockSubGraph;
+  typedef block_graph::BasicCodeBlock BasicCodeBlock;
+  typedef block_graph::BlockGraph BlockGraph;
+  typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
+  typedef block_graph::analysis::LivenessAnalysis LivenessAnalysis;
+  typedef grinder::basic_block_util::IndexedFrequencyMap IndexedFrequencyMap;
+  typedef grinder::basic_block_util::RelativeAddress RelativeAddress;
+
+  // The largest basic block which may get copied in place of a jump to it.
+  static const size_t kMaxInlinedReturnSize = 8;
+
+  // The longest chain of jumps which gets folded.
+  static const size_t kMaxJumpChainLength = 8;
+
+  // Initializes a new PeepholeTransform instance.
+  // @param frequencies The basic-block frequencies of the image, keyed by the
+  //     address of the basic blocks in the original image. This must outlive
+  //     the transform.
+  explicit PeepholeTransform(const IndexedFrequencyMap* frequencies);
+
+  // @name Statistics, valid after the transform has been applied.
+  // @{
+  size_t removed_move_count() const { return removed_move_count_; }
+  size_t folded_jump_count() const { return folded_jump_count_; }
+  size_t inlined_return_count() const { return inlined_return_count_; }
+  // @}
+
+  // The transform name.
+  static const char kTransformName[];
+
+ protected:
+  friend IterativeTransformImpl<PeepholeTransform>;
+
+  // @name IterativeTransformImpl implementation.
+  // @{
+  bool OnBlock(const TransformPolicyInterface* policy,
+               BlockGraph* block_graph,
+               BlockGraph::Block* block);
+  bool PostBlockGraphIteration(const TransformPolicyInterface* policy,
+                               BlockGraph* block_graph,
+                               BlockGraph::Block* header_block);
+  // @}
+
+  // @name BasicBlockSubGraphTransformInterface implementation.
+  // @{
+  virtual bool TransformBasicBlockSubGraph(
+      const TransformPolicyInterface* policy,
+      BlockGraph* block_graph,
+      BasicBlockSubGraph* basic_block_subgraph) OVERRIDE;
+  // @}
+
+  // @name The rewrites, applied to a single basic block.
+  // @{
+  // Removes the redundant moves of @p bb.
+  // @param liveness The global liveness analysis of the subgraph of @p bb.
+  // @param bb The basic block to rewrite.
+  // @returns the number of removed instructions.
+  size_t RemoveRedundantMoves(const LivenessAnalysis& liveness,
+                              BasicCodeBlock* bb);
+
+  // Redirects the successors of @p bb which go through a chain of jumps.
+  // @param bb The basic block to rewrite.
+  // @returns the number of redirected successors.
+  size_t FoldJumpChains(BasicCodeBlock* bb);
+
+  // Replaces the jump ending @p bb with a copy of its target, if that's a
+  // tiny basic block which returns.
+  // @param bb The basic block to rewrite.
+  // @param next_bb The basic block laid out after @p bb, or NULL. A jump to
+  //     it costs nothing and is left alone.
+  // @returns true if the jump got replaced.
+  bool InlineReturn(BasicCodeBlock* bb, const BasicBlock* next_bb);
+  // @}
+
+  // @param block The block a basic block comes from.
+  // @param bb A basic block.
+  // @returns true if @p bb was executed according to the profile.
+  bool IsHot(const BlockGraph::Block* block, const BasicBlock* bb) const;
+
+  // @param block A code block.
+  // @returns true if any of the basic blocks of @p block was executed.
+  bool HasHotCode(const BlockGraph::Block* block) const;
+
+  // The profiled basic-block frequencies.
+  const IndexedFrequencyMap* frequencies_;
+
+  // The statistics.
+  size_t removed_move_count_;
+  size_t folded_jump_count_;
+  size_t inlined_return_count_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(PeepholeTransform);
+};
+
+}  // namespace transforms
+}  // namespace optimize
+
+#endif  // SYZYGY_OPTIMIZE_TRANSFORMS_PEEPHOLE_TRANSFORM_H_
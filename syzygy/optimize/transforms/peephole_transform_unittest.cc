@@ -0,0 +1,179 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/optimize/transforms/peephole_transform.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/basic_block_assembler.h"
+#include "syzygy/block_graph/basic_block_test_util.h"
+
+namespace optimize {
+namespace transforms {
+
+namespace {
+
+using block_graph::BasicBlock;
+using block_graph::BasicBlockAssembler;
+using block_graph::BasicBlockReference;
+using block_graph::BasicBlockSubGraph;
+using block_graph::BasicCodeBlock;
+using block_graph::BlockGraph;
+using block_graph::Immediate;
+using block_graph::Successor;
+
+class TestPeepholeTransform : public PeepholeTransform {
+ public:
+  explicit TestPeepholeTransform(const IndexedFrequencyMap* frequencies)
+      : PeepholeTransform(frequencies) {
+  }
+
+  using PeepholeTransform::FoldJumpChains;
+  using PeepholeTransform::HasHotCode;
+  using PeepholeTransform::InlineReturn;
+  using PeepholeTransform::IsHot;
+  using PeepholeTransform::RemoveRedundantMoves;
+  using PeepholeTransform::TransformBasicBlockSubGraph;
+};
+
+class PeepholeTransformTest : public testing::BasicBlockTest {
+ public:
+  typedef PeepholeTransform::IndexedFrequencyMap IndexedFrequencyMap;
+
+  void AddSuccessor(Successor::Condition condition,
+                    BasicCodeBlock* from,
+                    BasicBlock* to) {
+    from->successors().push_back(
+        Successor(condition,
+                  BasicBlockReference(BlockGraph::PC_RELATIVE_REF,
+                                      BlockGraph::Reference::kMaximumSize,
+                                      to),
+                  0));
+  }
+
+  IndexedFrequencyMap frequencies_;
+};
+
+}  // namespace
+
+TEST_F(PeepholeTransformTest, RemoveRedundantMoves) {
+  BasicBlockSubGraph subgraph;
+  BasicCodeBlock* bb = subgraph.AddBasicCodeBlock("bb");
+  ASSERT_TRUE(bb != NULL);
+
+  BasicBlockAssembler assembly(bb->instructions().end(), &bb->instructions());
+  assembly.mov(core::edx, core::edx);
+  assembly.mov(core::ecx, Immediate(42, core::kSize32Bit));
+  assembly.mov(core::ecx, Immediate(43, core::kSize32Bit));
+  assembly.mov(core::esp, Immediate(44, core::kSize32Bit));
+  assembly.mov(core::esp, core::ebp);
+  assembly.ret();
+
+  PeepholeTransform::LivenessAnalysis liveness;
+  liveness.Analyze(&subgraph);
+
+  // The self move and the first write to ecx go, the stack pointer is never
+  // considered dead.
+  TestPeepholeTransform transform(&frequencies_);
+  EXPECT_EQ(2U, transform.RemoveRedundantMoves(liveness, bb));
+  EXPECT_EQ(4U, bb->instructions().size());
+  const _DInst& repr = bb->instructions().front().representation();
+  EXPECT_EQ(I_MOV, repr.opcode);
+  EXPECT_EQ(43U, repr.imm.dword);
+}
+
+TEST_F(PeepholeTransformTest, FoldJumpChains) {
+  BasicBlockSubGraph subgraph;
+  BasicCodeBlock* bb_if = subgraph.AddBasicCodeBlock("if");
+  BasicCodeBlock* bb_jump1 = subgraph.AddBasicCodeBlock("jump1");
+  BasicCodeBlock* bb_jump2 = subgraph.AddBasicCodeBlock("jump2");
+  BasicCodeBlock* bb_loop = subgraph.AddBasicCodeBlock("loop");
+  BasicCodeBlock* bb_end = subgraph.AddBasicCodeBlock("end");
+
+  // The taken branch goes through two jumps, the other one into a loop of
+  // jumps.
+  AddSuccessor(Successor::kConditionEqual, bb_if, bb_jump1);
+  AddSuccessor(Successor::kConditionNotEqual, bb_if, bb_loop);
+  AddSuccessor(Successor::kConditionTrue, bb_jump1, bb_jump2);
+  AddSuccessor(Successor::kConditionTrue, bb_jump2, bb_end);
+  AddSuccessor(Successor::kConditionTrue, bb_loop, bb_loop);
+
+  TestPeepholeTransform transform(&frequencies_);
+  EXPECT_EQ(1U, transform.FoldJumpChains(bb_if));
+  EXPECT_EQ(bb_end, bb_if->successors().front().reference().basic_block());
+  EXPECT_EQ(bb_loop, bb_if->successors().back().reference().basic_block());
+  EXPECT_EQ(0U, transform.FoldJumpChains(bb_if));
+}
+
+TEST_F(PeepholeTransformTest, InlineReturn) {
+  BasicBlockSubGraph subgraph;
+  BasicCodeBlock* bb = subgraph.AddBasicCodeBlock("bb");
+  BasicCodeBlock* bb_ret = subgraph.AddBasicCodeBlock("ret");
+  BasicCodeBlock* bb_large_ret = subgraph.AddBasicCodeBlock("large_ret");
+
+  BasicBlockAssembler ret_assembly(bb_ret->instructions().end(),
+                                   &bb_ret->instructions());
+  ret_assembly.pop(core::ebp);
+  ret_assembly.ret(4);
+
+  BasicBlockAssembler large_assembly(bb_large_ret->instructions().end(),
+                                     &bb_large_ret->instructions());
+  large_assembly.mov(core::eax, Immediate(1, core::kSize32Bit));
+  large_assembly.pop(core::ebp);
+  large_assembly.ret(4);
+
+  TestPeepholeTransform transform(&frequencies_);
+
+  // A jump which falls through costs nothing.
+  AddSuccessor(Successor::kConditionTrue, bb, bb_ret);
+  EXPECT_FALSE(transform.InlineReturn(bb, bb_ret));
+
+  EXPECT_TRUE(transform.InlineReturn(bb, NULL));
+  EXPECT_TRUE(bb->successors().empty());
+  ASSERT_EQ(2U, bb->instructions().size());
+  EXPECT_TRUE(bb->instructions().back().IsReturn());
+  EXPECT_EQ(2U, bb_ret->instructions().size());
+
+  // A larger epilog isn't copied.
+  BasicCodeBlock* bb2 = subgraph.AddBasicCodeBlock("bb2");
+  AddSuccessor(Successor::kConditionTrue, bb2, bb_large_ret);
+  EXPECT_FALSE(transform.InlineReturn(bb2, NULL));
+  EXPECT_EQ(1U, bb2->successors().size());
+}
+
+TEST_F(PeepholeTransformTest, OnlyRewritesHotCode) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+  ASSERT_NO_FATAL_FAILURE(InitBasicBlockSubGraph());
+  TestPeepholeTransform transform(&frequencies_);
+
+  EXPECT_FALSE(transform.HasHotCode(assembly_func_));
+  EXPECT_FALSE(transform.IsHot(assembly_func_, bbs_[0]));
+
+  frequencies_[std::make_pair(start_addr_, 0U)] = 1;
+  EXPECT_TRUE(transform.HasHotCode(assembly_func_));
+  EXPECT_TRUE(transform.IsHot(assembly_func_, bbs_[0]));
+  EXPECT_FALSE(transform.IsHot(assembly_func_, bbs_[2]));
+
+  // The self move of case_0 goes once it's hot.
+  frequencies_[std::make_pair(start_addr_ + bbs_[2]->offset(), 0U)] = 1;
+  ASSERT_EQ(2U, bbs_[2]->instructions().size());
+  ASSERT_TRUE(transform.TransformBasicBlockSubGraph(
+      &policy_, &block_graph_, &subgraph_));
+  EXPECT_EQ(1U, transform.removed_move_count());
+  EXPECT_EQ(0U, transform.folded_jump_count());
+  EXPECT_EQ(0U, transform.inlined_return_count());
+  EXPECT_EQ(1U, bbs_[2]->instructions().size());
+}
+
+}  // namespace transforms
+}  // namespace optimize
@@ -0,0 +1,28 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/optimize/unittest_util.h"
+
+#include "base/logging.h"
+
+namespace testing {
+
+void BasicBlockFrequencyTest::SetEntryCount(size_t bb_index,
+                                            EntryCountType count) {
+  DCHECK_LT(bb_index, bbs_.size());
+  RelativeAddress address = start_addr_ + bbs_[bb_index]->offset();
+  frequencies_[std::make_pair(address, 0U)] = count;
+}
+
+}  // namespace testing
@@ -0,0 +1,43 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares utilities for building unittests of the profile guided transforms.
+
+#ifndef SYZYGY_OPTIMIZE_UNITTEST_UTIL_H_
+#define SYZYGY_OPTIMIZE_UNITTEST_UTIL_H_
+
+#include "syzygy/block_graph/basic_block_test_util.h"
+#include "syzygy/grinder/basic_block_util.h"
+
+namespace testing {
+
+// A basic-block test fixture that carries the profiled basic-block
+// frequencies of the assembly function.
+class BasicBlockFrequencyTest : public BasicBlockTest {
+ public:
+  typedef grinder::basic_block_util::EntryCountType EntryCountType;
+  typedef grinder::basic_block_util::IndexedFrequencyMap IndexedFrequencyMap;
+
+  // Sets the entry count of the basic block @p bb_index of assembly_func_.
+  // @param bb_index The index of the basic block in bbs_.
+  // @param count The entry count.
+  void SetEntryCount(size_t bb_index, EntryCountType count);
+
+  // The profiled basic-block frequencies.
+  IndexedFrequencyMap frequencies_;
+};
+
+}  // namespace testing
+
+#endif  // SYZYGY_OPTIMIZE_UNITTEST_UTIL_H_
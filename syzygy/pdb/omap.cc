@@ -57,6 +57,77 @@ core::RelativeAddress TranslateAddressViaOmap(const std::vector<OMAP>& omaps,
       (address - core::RelativeAddress(it->rva));
 }
 
+OmapTranslator::OmapTranslator() {
+}
+
+void OmapTranslator::Init(const std::vector<OMAP>& omaps) {
+  DCHECK(OmapVectorIsValid(omaps));
+
+  omaps_ = omaps;
+  page_table_.clear();
+  if (omaps_.empty())
+    return;
+
+  // Each page starts at the first entry that isn't before it.
+  size_t page_count = omaps_.back().rva / kPageSize + 1;
+  page_table_.resize(page_count + 1);
+  size_t index = 0;
+  for (size_t page = 0; page < page_count; ++page) {
+    while (index < omaps_.size() && omaps_[index].rva < page * kPageSize)
+      ++index;
+    page_table_[page] = static_cast<uint32>(index);
+  }
+  page_table_[page_count] = static_cast<uint32>(omaps_.size());
+}
+
+core::RelativeAddress OmapTranslator::Translate(
+    core::RelativeAddress address) const {
+  // Addresses past the last page are beyond all of the entries.
+  size_t page = address.value() / kPageSize;
+  if (page + 1 >= page_table_.size())
+    return TranslateWithEntry(omaps_.end(), address);
+
+  // The entries that precede the page are all before the address, and those
+  // that follow it are all after it, so only the entries of the page need to
+  // be searched.
+  OMAP omap_address = CreateOmap(address.value(), 0);
+  std::vector<OMAP>::const_iterator it =
+      std::upper_bound(omaps_.begin() + page_table_[page],
+                       omaps_.begin() + page_table_[page + 1],
+                       omap_address,
+                       OmapLess);
+  return TranslateWithEntry(it, address);
+}
+
+void OmapTranslator::TranslateSorted(
+    const std::vector<core::RelativeAddress>& addresses,
+    std::vector<core::RelativeAddress>* translated) const {
+  DCHECK(translated != NULL);
+
+  translated->resize(addresses.size());
+  std::vector<OMAP>::const_iterator it = omaps_.begin();
+  for (size_t i = 0; i < addresses.size(); ++i) {
+    DCHECK(i == 0 || addresses[i - 1] <= addresses[i]);
+    while (it != omaps_.end() && it->rva <= addresses[i].value())
+      ++it;
+    (*translated)[i] = TranslateWithEntry(it, addresses[i]);
+  }
+}
+
+core::RelativeAddress OmapTranslator::TranslateWithEntry(
+    std::vector<OMAP>::const_iterator omap,
+    core::RelativeAddress address) const {
+  // If we are at the first OMAP entry, the address is before any addresses
+  // that are OMAPped. Thus, we return the same address.
+  if (omap == omaps_.begin())
+    return address;
+
+  // Otherwise, the previous OMAP entry tells us where we lie.
+  --omap;
+  return core::RelativeAddress(omap->rvaTo) +
+      (address - core::RelativeAddress(omap->rva));
+}
+
 bool ReadOmapsFromPdbFile(const PdbFile& pdb_file,
                           std::vector<OMAP>* omap_to,
                           std::vector<OMAP>* omap_from) {
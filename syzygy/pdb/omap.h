@@ -53,6 +53,65 @@ bool OmapVectorIsValid(const std::vector<OMAP>& omaps);
 core::RelativeAddress TranslateAddressViaOmap(const std::vector<OMAP>& omaps,
                                               core::RelativeAddress address);
 
+// Translates addresses through OMAP information in constant time. This
+// builds a table which, for each page of the address space covered by the
+// OMAP entries, holds the index of the first entry of that page. A
+// translation then only searches the few entries of its page, rather than the
+// whole vector. Sample usage:
+//
+//   OmapTranslator translator;
+//   translator.Init(omaps);
+//   core::RelativeAddress rva = translator.Translate(address);
+//
+// The translations are identical to those of TranslateAddressViaOmap.
+class OmapTranslator {
+ public:
+  // The granularity of the page table, in bytes.
+  static const size_t kPageSize = 0x1000;
+
+  OmapTranslator();
+
+  // Builds the page table.
+  // @param omaps the vector of OMAPs to apply.
+  // @pre OmapVectorIsValid(omaps) is true.
+  void Init(const std::vector<OMAP>& omaps);
+
+  // @returns true if there are no OMAP entries, in which case addresses are
+  //     translated to themselves.
+  bool empty() const { return omaps_.empty(); }
+
+  // Maps an address through the OMAP information.
+  // @param address the address to map.
+  // @returns the mapped address.
+  core::RelativeAddress Translate(core::RelativeAddress address) const;
+
+  // Maps a sequence of addresses through the OMAP information. This walks the
+  // OMAP entries alongside the addresses, in linear time.
+  // @param addresses the addresses to map, in increasing order.
+  // @param translated receives the mapped addresses, in the same order.
+  void TranslateSorted(const std::vector<core::RelativeAddress>& addresses,
+                       std::vector<core::RelativeAddress>* translated) const;
+
+ private:
+  // Maps an address through an OMAP entry.
+  // @param omap the OMAP entry following the one to apply.
+  // @param address the address to map.
+  // @returns the mapped address.
+  core::RelativeAddress TranslateWithEntry(
+      std::vector<OMAP>::const_iterator omap,
+      core::RelativeAddress address) const;
+
+  // The OMAP entries.
+  std::vector<OMAP> omaps_;
+
+  // For each page, the index of the first OMAP entry located at or after the
+  // start of the page. This has one more element than there are pages
+  // holding OMAP entries, the last one being the number of entries.
+  std::vector<uint32> page_table_;
+
+  DISALLOW_COPY_AND_ASSIGN(OmapTranslator);
+};
+
 // Reads OMAP tables from a PdbFile. The destination vectors may be NULL if
 // they are not required to be read. Even if neither stream is read they will be
 // checked for existence.
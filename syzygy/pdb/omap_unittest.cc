@@ -14,6 +14,8 @@
 
 #include "syzygy/pdb/omap.h"
 
+#include <algorithm>
+
 #include "base/path_service.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
@@ -82,6 +84,48 @@ TEST(OmapTest, Translate) {
             TranslateAddressViaOmap(omaps, RelativeAddress(3500)));
 }
 
+TEST(OmapTest, OmapTranslatorIsEquivalent) {
+  std::vector<OMAP> omaps;
+
+  // Several entries per page, and pages without any entries.
+  omaps.push_back(CreateOmap(1000, 9000));
+  omaps.push_back(CreateOmap(1010, 1000));
+  omaps.push_back(CreateOmap(4096, 20000));
+  omaps.push_back(CreateOmap(4097, 4096));
+  omaps.push_back(CreateOmap(5000, 0));
+  omaps.push_back(CreateOmap(20000, 30000));
+  omaps.push_back(CreateOmap(20010, 20010));
+  ASSERT_TRUE(OmapVectorIsValid(omaps));
+
+  OmapTranslator translator;
+  translator.Init(omaps);
+  EXPECT_FALSE(translator.empty());
+
+  std::vector<RelativeAddress> addresses;
+  for (uint32 rva = 0; rva < 25000; rva += 7)
+    addresses.push_back(RelativeAddress(rva));
+  addresses.push_back(RelativeAddress(4096));
+  addresses.push_back(RelativeAddress(20010));
+  std::sort(addresses.begin(), addresses.end());
+
+  std::vector<RelativeAddress> translated;
+  translator.TranslateSorted(addresses, &translated);
+  ASSERT_EQ(addresses.size(), translated.size());
+
+  for (size_t i = 0; i < addresses.size(); ++i) {
+    RelativeAddress expected = TranslateAddressViaOmap(omaps, addresses[i]);
+    EXPECT_EQ(expected, translator.Translate(addresses[i]));
+    EXPECT_EQ(expected, translated[i]);
+  }
+}
+
+TEST(OmapTest, OmapTranslatorEmpty) {
+  OmapTranslator translator;
+  translator.Init(std::vector<OMAP>());
+  EXPECT_TRUE(translator.empty());
+  EXPECT_EQ(RelativeAddress(1234), translator.Translate(RelativeAddress(1234)));
+}
+
 TEST(OmapTest, ReadOmapsFromPdbFile) {
   std::vector<OMAP> omap_to, omap_from;
 
@@ -38,11 +38,15 @@
         'pdb_file.h',
         'pdb_file_stream.cc',
         'pdb_file_stream.h',
+        'pdb_mapped_stream.cc',
+        'pdb_mapped_stream.h',
         'pdb_mutator.h',
         'pdb_reader.cc',
         'pdb_reader.h',
         'pdb_stream.cc',
         'pdb_stream.h',
+        'pdb_symbol_hash_table.cc',
+        'pdb_symbol_hash_table.h',
         'pdb_symbol_record.cc',
         'pdb_symbol_record.h',
         'pdb_type_info_stream.cc',
@@ -55,6 +59,7 @@
       'dependencies': [
         '<(src)/base/base.gyp:base',
         '<(src)/sawbuck/common/common.gyp:common',
+        '<(src)/syzygy/common/common.gyp:stage_profiler_lib',
       ],
     },
     {
@@ -80,8 +85,10 @@
         'pdb_dbi_stream_unittest.cc',
         'pdb_file_stream_unittest.cc',
         'pdb_file_unittest.cc',
+        'pdb_mapped_stream_unittest.cc',
         'pdb_reader_unittest.cc',
         'pdb_stream_unittest.cc',
+        'pdb_symbol_hash_table_unittest.cc',
         'pdb_symbol_record_unittest.cc',
         'pdb_type_info_stream_unittest.cc',
         'pdb_util_unittest.cc',
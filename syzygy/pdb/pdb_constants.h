@@ -43,6 +43,14 @@ const size_t kTpiStream = 2;
 // The index of the Dbi info stream.
 const size_t kDbiStream = 3;
 
+// The signature and version we've observed in the header of the global and
+// public symbol hash tables.
+const uint32 kPdbSymbolHashSignature = 0xFFFFFFFF;
+const uint32 kPdbSymbolHashVersion = 0xEFFE0000 + 19990810;
+
+// The number of buckets in the global and public symbol hash tables.
+const uint32 kPdbSymbolHashBucketCount = 4096;
+
 // This is the magic value found at the start of all MSF v7.00 files.
 const size_t kPdbHeaderMagicStringSize = 32;
 extern const uint8 kPdbHeaderMagicString[kPdbHeaderMagicStringSize];
@@ -256,6 +256,51 @@ struct PdbFixup {
 // exactly 12 bytes in size.
 COMPILE_ASSERT_IS_POD_OF_SIZE(PdbFixup, 12);
 
+// The header of a global symbol hash table. This makes up the start of the
+// global symbol info stream, and follows the PublicSymbolHashHeader in the
+// public symbol info stream.
+// See http://llvm.org/docs/PDB/GlobalStream.html
+struct SymbolHashHeader {
+  uint32 signature;
+  uint32 version;
+  // The size of the hash records that follow, in bytes.
+  uint32 hash_records_size;
+  // The size of the bucket bitmap and the bucket offsets, in bytes.
+  uint32 buckets_size;
+};
+// We coerce a stream of bytes to this structure, so we require it to be
+// exactly 16 bytes in size.
+COMPILE_ASSERT_IS_POD_OF_SIZE(SymbolHashHeader, 16);
+
+// A record of a global symbol hash table.
+struct SymbolHashRecord {
+  // The offset of the symbol in the symbol record stream, plus one.
+  uint32 offset;
+  uint32 reference_count;
+};
+// We coerce a stream of bytes to this structure, so we require it to be
+// exactly 8 bytes in size.
+COMPILE_ASSERT_IS_POD_OF_SIZE(SymbolHashRecord, 8);
+
+// The header of the public symbol info stream. This is followed by a symbol
+// hash table, and then by the address map.
+// See http://llvm.org/docs/PDB/PublicStream.html
+struct PublicSymbolHashHeader {
+  // The size of the symbol hash table, in bytes.
+  uint32 symbol_hash_size;
+  // The size of the address map, in bytes.
+  uint32 address_map_size;
+  uint32 thunk_count;
+  uint32 thunk_size;
+  uint16 thunk_table_section;
+  uint16 padding;
+  uint32 thunk_table_offset;
+  uint32 section_count;
+};
+// We coerce a stream of bytes to this structure, so we require it to be
+// exactly 28 bytes in size.
+COMPILE_ASSERT_IS_POD_OF_SIZE(PublicSymbolHashHeader, 28);
+
 }  // namespace pdb
 
 #endif  // SYZYGY_PDB_PDB_DATA_H_
@@ -16,6 +16,7 @@
 #define SYZYGY_PDB_PDB_FILE_STREAM_H_
 
 #include <stdio.h>
+#include <vector>
 
 #include "base/basictypes.h"
 #include "base/memory/ref_counted.h"
@@ -66,6 +67,14 @@ class PdbFileStream : public PdbStream {
   // PdbStream implementation.
   bool ReadBytes(void* dest, size_t count, size_t* bytes_read);
 
+  // @name Accessors.
+  // @{
+  // @returns the indices of the pages that make up this stream in the file.
+  const std::vector<uint32>& pages() const { return pages_; }
+  // @returns the size of the pages, in bytes.
+  size_t page_size() const { return page_size_; }
+  // @}
+
  protected:
   // Protected to enforce reference counted pointers at compile time.
   virtual ~PdbFileStream();
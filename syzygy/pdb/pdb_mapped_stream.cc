@@ -0,0 +1,201 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pdb/pdb_mapped_stream.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "sawbuck/common/com_utils.h"
+
+namespace pdb {
+
+RefCountedMappedFile::RefCountedMappedFile()
+    : file_(INVALID_HANDLE_VALUE),
+      mapping_(NULL),
+      data_(NULL),
+      size_(0) {
+}
+
+RefCountedMappedFile::~RefCountedMappedFile() {
+  Close();
+}
+
+bool RefCountedMappedFile::Init(const base::FilePath& path) {
+  DCHECK(data_ == NULL);
+
+  file_ = ::CreateFile(path.value().c_str(),
+                       GENERIC_READ,
+                       FILE_SHARE_READ,
+                       NULL,
+                       OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS,
+                       NULL);
+  if (file_ == INVALID_HANDLE_VALUE) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to open \"" << path.value() << "\": "
+               << com::LogWe(error) << ".";
+    return false;
+  }
+
+  LARGE_INTEGER file_size = {};
+  if (!::GetFileSizeEx(file_, &file_size)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to get size of \"" << path.value() << "\": "
+               << com::LogWe(error) << ".";
+    Close();
+    return false;
+  }
+  if (file_size.HighPart != 0 || file_size.LowPart == 0) {
+    LOG(ERROR) << "Unable to map \"" << path.value() << "\" of size "
+               << file_size.QuadPart << ".";
+    Close();
+    return false;
+  }
+  size_ = file_size.LowPart;
+
+  mapping_ = ::CreateFileMapping(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping_ == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to create mapping of \"" << path.value() << "\": "
+               << com::LogWe(error) << ".";
+    Close();
+    return false;
+  }
+
+  data_ = reinterpret_cast<const uint8*>(
+      ::MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  if (data_ == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to map view of \"" << path.value() << "\": "
+               << com::LogWe(error) << ".";
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+void RefCountedMappedFile::Close() {
+  if (data_ != NULL) {
+    ::UnmapViewOfFile(data_);
+    data_ = NULL;
+  }
+  if (mapping_ != NULL) {
+    ::CloseHandle(mapping_);
+    mapping_ = NULL;
+  }
+  if (file_ != INVALID_HANDLE_VALUE) {
+    ::CloseHandle(file_);
+    file_ = INVALID_HANDLE_VALUE;
+  }
+  size_ = 0;
+}
+
+PdbMappedStream::PdbMappedStream(RefCountedMappedFile* file,
+                                 size_t length,
+                                 const uint32* pages,
+                                 size_t page_size)
+    : PdbStream(length),
+      file_(file),
+      page_size_(page_size) {
+  DCHECK(file != NULL);
+  DCHECK_LT(0u, page_size);
+  size_t num_pages = (length + page_size - 1) / page_size;
+  pages_.assign(pages, pages + num_pages);
+}
+
+PdbMappedStream::~PdbMappedStream() {
+}
+
+bool PdbMappedStream::ReadBytes(void* dest, size_t count, size_t* bytes_read) {
+  DCHECK(dest != NULL);
+  DCHECK(bytes_read != NULL);
+
+  // Return 0 once we've reached the end of the stream.
+  if (pos() == length()) {
+    *bytes_read = 0;
+    return true;
+  }
+
+  // Don't read beyond the end of the known stream length.
+  count = std::min(count, length() - pos());
+  *bytes_read = count;
+
+  // Copy the stream out of the mapping, a page at a time.
+  while (count > 0) {
+    size_t page_index = pos() / page_size_;
+    size_t offset = pos() % page_size_;
+    size_t chunk_size = std::min(count, page_size_ - offset);
+    const uint8* data = GetPageData(page_index, offset);
+    if (data == NULL || data + chunk_size > file_->data() + file_->size()) {
+      LOG(ERROR) << "Page read failed";
+      return false;
+    }
+    ::memcpy(dest, data, chunk_size);
+
+    count -= chunk_size;
+    Seek(pos() + chunk_size);
+    dest = reinterpret_cast<uint8*>(dest) + chunk_size;
+  }
+
+  return true;
+}
+
+bool PdbMappedStream::GetContiguousData(size_t offset,
+                                        size_t count,
+                                        const uint8** data) const {
+  DCHECK(data != NULL);
+
+  if (offset > length() || count > length() - offset)
+    return false;
+
+  size_t page_index = offset / page_size_;
+  const uint8* begin = GetPageData(page_index, offset % page_size_);
+  if (begin == NULL)
+    return false;
+
+  // Make sure each subsequent page touched by the range immediately follows
+  // its predecessor in the file.
+  if (count > 0) {
+    size_t last_page_index = (offset + count - 1) / page_size_;
+    for (size_t i = page_index + 1; i <= last_page_index; ++i) {
+      if (pages_[i] != pages_[i - 1] + 1)
+        return false;
+    }
+  }
+
+  if (begin + count > file_->data() + file_->size())
+    return false;
+
+  *data = begin;
+  return true;
+}
+
+const uint8* PdbMappedStream::GetPageData(size_t page_index,
+                                          size_t offset) const {
+  DCHECK_LT(offset, page_size_);
+
+  // An empty stream has no pages.
+  if (page_index >= pages_.size())
+    return NULL;
+
+  size_t file_offset = pages_[page_index] * page_size_ + offset;
+  if (file_offset >= file_->size())
+    return NULL;
+
+  return file_->data() + file_offset;
+}
+
+}  // namespace pdb
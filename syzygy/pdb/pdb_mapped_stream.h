@@ -0,0 +1,124 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares PdbMappedStream, a PDB stream that reads its pages directly out of
+// a read-only mapping of the whole PDB file. This avoids a seek and a read
+// system call per page, and allows consumers to get at stream contents
+// without making a copy of them.
+
+#ifndef SYZYGY_PDB_PDB_MAPPED_STREAM_H_
+#define SYZYGY_PDB_PDB_MAPPED_STREAM_H_
+
+#include <windows.h>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/files/file_path.h"
+#include "base/memory/ref_counted.h"
+#include "syzygy/pdb/pdb_stream.h"
+
+namespace pdb {
+
+// A reference counted read-only mapping of an entire file.
+class RefCountedMappedFile : public base::RefCounted<RefCountedMappedFile> {
+ public:
+  RefCountedMappedFile();
+
+  // Maps the file at @p path into memory.
+  // @param path the path of the file to map.
+  // @returns true on success, false otherwise.
+  bool Init(const base::FilePath& path);
+
+  // @returns a pointer to the mapped contents of the file.
+  const uint8* data() const { return data_; }
+
+  // @returns the size of the mapped file, in bytes.
+  size_t size() const { return size_; }
+
+ private:
+  friend base::RefCounted<RefCountedMappedFile>;
+
+  // We disallow access to the destructor to enforce the use of reference
+  // counting pointers.
+  ~RefCountedMappedFile();
+
+  // Releases the mapping and the handles backing it.
+  void Close();
+
+  HANDLE file_;
+  HANDLE mapping_;
+  const uint8* data_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(RefCountedMappedFile);
+};
+
+// This class represents a PDB stream living in a memory mapped PDB file.
+class PdbMappedStream : public PdbStream {
+ public:
+  // Constructor.
+  // @param file the reference counted mapping housing this stream.
+  // @param length the length of this stream.
+  // @param pages the indices of the pages that make up this stream in the file.
+  //     A copy is made of the data so the pointer need not remain valid
+  //     beyond the constructor. The length of this array is implicit in the
+  //     stream length and the page size.
+  // @param page_size the size of the pages, in bytes.
+  PdbMappedStream(RefCountedMappedFile* file,
+                  size_t length,
+                  const uint32* pages,
+                  size_t page_size);
+
+  // PdbStream implementation.
+  virtual bool ReadBytes(void* dest, size_t count, size_t* bytes_read) OVERRIDE;
+
+  // Gets a pointer to @p count bytes of the stream starting at @p offset,
+  // without copying them. This only succeeds if the bytes are contiguous in
+  // the underlying file, which is always the case for ranges that don't cross
+  // a page boundary. This does not modify the read position.
+  // @param offset the offset in the stream of the first byte.
+  // @param count the number of bytes.
+  // @param data will receive a pointer to the data on success.
+  // @returns true on success, false if the range is out of bounds or spans
+  //     discontiguous pages.
+  bool GetContiguousData(size_t offset, size_t count, const uint8** data) const;
+
+  // @returns the size of the pages making up this stream.
+  size_t page_size() const { return page_size_; }
+
+ protected:
+  // Protected to enforce reference counted pointers at compile time.
+  virtual ~PdbMappedStream();
+
+  // Gets a pointer to @p offset bytes into page @p page_index of the stream,
+  // or NULL if that page lies outside of the file.
+  const uint8* GetPageData(size_t page_index, size_t offset) const;
+
+ private:
+  // The mapping of the PDB file. This is reference counted so that streams can
+  // outlive the PdbReader that created them.
+  scoped_refptr<RefCountedMappedFile> file_;
+
+  // The list of pages in the PDB file that make up this stream.
+  std::vector<uint32> pages_;
+
+  // The size of pages within the stream.
+  size_t page_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(PdbMappedStream);
+};
+
+}  // namespace pdb
+
+#endif  // SYZYGY_PDB_PDB_MAPPED_STREAM_H_
@@ -0,0 +1,162 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pdb/pdb_mapped_stream.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/pdb/pdb_byte_stream.h"
+#include "syzygy/pdb/pdb_constants.h"
+#include "syzygy/pdb/pdb_data.h"
+#include "syzygy/pdb/pdb_reader.h"
+#include "syzygy/pdb/unittest_util.h"
+
+namespace pdb {
+
+namespace {
+
+class PdbMappedStreamTest : public testing::Test {
+ public:
+  virtual void SetUp() {
+    file_ = new RefCountedMappedFile();
+    ASSERT_TRUE(file_->Init(
+        testing::GetSrcRelativePath(testing::kTestPdbFilePath)));
+    ASSERT_TRUE(file_->data() != NULL);
+    ASSERT_LT(sizeof(PdbHeader), file_->size());
+  }
+
+ protected:
+  scoped_refptr<RefCountedMappedFile> file_;
+};
+
+}  // namespace
+
+TEST_F(PdbMappedStreamTest, InitFailsForMissingFile) {
+  scoped_refptr<RefCountedMappedFile> file(new RefCountedMappedFile());
+  EXPECT_FALSE(file->Init(base::FilePath(L"C:\\this\\file\\does\\not.exist")));
+  EXPECT_TRUE(file->data() == NULL);
+}
+
+TEST_F(PdbMappedStreamTest, Constructor) {
+  uint32 pages[] = {1, 2, 3};
+  scoped_refptr<PdbMappedStream> stream(
+      new PdbMappedStream(file_, 10, pages, 8));
+  EXPECT_EQ(10, stream->length());
+  EXPECT_EQ(8, stream->page_size());
+}
+
+TEST_F(PdbMappedStreamTest, ReadBytes) {
+  // Different sections of the pdb header magic string.
+  char* test_cases[] = {
+    "Mic",
+    "roso",
+    "ft",
+    " C/C+",
+    "+ MS",
+    "F 7.00"
+  };
+
+  // Test that we can read varying sizes of bytes from the header of the
+  // file with varying page sizes.
+  char buffer[8] = {0};
+  for (size_t page_size = 4; page_size <= 32; page_size *= 2) {
+    uint32 pages[] = {0, 1, 2, 3, 4, 5, 6, 7};
+    scoped_refptr<PdbMappedStream> stream(new PdbMappedStream(
+        file_.get(), sizeof(PdbHeader), pages, page_size));
+
+    for (uint32 j = 0; j < arraysize(test_cases); ++j) {
+      char* test_case = test_cases[j];
+      size_t len = strlen(test_case);
+      size_t bytes_read = 0;
+      EXPECT_TRUE(stream->ReadBytes(&buffer, len, &bytes_read));
+      EXPECT_EQ(0, memcmp(buffer, test_case, len));
+      EXPECT_EQ(len, bytes_read);
+    }
+  }
+}
+
+TEST_F(PdbMappedStreamTest, ReadBytesFailsPastEndOfFile) {
+  uint32 pages[] = {0xFFFFFF};
+  scoped_refptr<PdbMappedStream> stream(
+      new PdbMappedStream(file_, 4, pages, 4));
+  char buffer[4] = {0};
+  size_t bytes_read = 0;
+  EXPECT_FALSE(stream->ReadBytes(&buffer, sizeof(buffer), &bytes_read));
+}
+
+TEST_F(PdbMappedStreamTest, GetContiguousData) {
+  // Pages 0 and 1 are contiguous, page 3 is not.
+  uint32 pages[] = {0, 1, 3};
+  scoped_refptr<PdbMappedStream> stream(
+      new PdbMappedStream(file_, 12, pages, 4));
+
+  const uint8* data = NULL;
+  EXPECT_TRUE(stream->GetContiguousData(0, 4, &data));
+  EXPECT_EQ(file_->data(), data);
+
+  EXPECT_TRUE(stream->GetContiguousData(2, 6, &data));
+  EXPECT_EQ(file_->data() + 2, data);
+  EXPECT_EQ(0, memcmp(data, "crosof", 6));
+
+  EXPECT_TRUE(stream->GetContiguousData(8, 4, &data));
+  EXPECT_EQ(file_->data() + 12, data);
+
+  // This range spans pages 1 and 3.
+  EXPECT_FALSE(stream->GetContiguousData(6, 4, &data));
+
+  // This range is out of bounds.
+  EXPECT_FALSE(stream->GetContiguousData(10, 4, &data));
+
+  // The read position is untouched.
+  EXPECT_EQ(0u, stream->pos());
+}
+
+TEST_F(PdbMappedStreamTest, ReaderProducesIdenticalStreams) {
+  base::FilePath pdb_path =
+      testing::GetSrcRelativePath(testing::kTestPdbFilePath);
+
+  PdbReader file_reader;
+  EXPECT_FALSE(file_reader.use_memory_mapping());
+  PdbFile file_pdb;
+  ASSERT_TRUE(file_reader.Read(pdb_path, &file_pdb));
+
+  PdbReader mapped_reader;
+  mapped_reader.set_use_memory_mapping(true);
+  EXPECT_TRUE(mapped_reader.use_memory_mapping());
+  PdbFile mapped_pdb;
+  ASSERT_TRUE(mapped_reader.Read(pdb_path, &mapped_pdb));
+
+  ASSERT_EQ(file_pdb.StreamCount(), mapped_pdb.StreamCount());
+  for (size_t i = 0; i < file_pdb.StreamCount(); ++i) {
+    scoped_refptr<PdbStream> file_stream = file_pdb.GetStream(i);
+    scoped_refptr<PdbStream> mapped_stream = mapped_pdb.GetStream(i);
+    if (file_stream.get() == NULL) {
+      EXPECT_TRUE(mapped_stream.get() == NULL);
+      continue;
+    }
+    ASSERT_TRUE(mapped_stream.get() != NULL);
+    ASSERT_EQ(file_stream->length(), mapped_stream->length());
+
+    scoped_refptr<PdbByteStream> file_bytes(new PdbByteStream());
+    scoped_refptr<PdbByteStream> mapped_bytes(new PdbByteStream());
+    ASSERT_TRUE(file_bytes->Init(file_stream.get()));
+    ASSERT_TRUE(mapped_bytes->Init(mapped_stream.get()));
+    if (file_stream->length() > 0) {
+      EXPECT_EQ(0, memcmp(file_bytes->data(), mapped_bytes->data(),
+                          file_stream->length()));
+    }
+  }
+}
+
+}  // namespace pdb
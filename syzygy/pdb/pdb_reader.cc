@@ -16,7 +16,9 @@
 
 #include "base/logging.h"
 #include "base/string_util.h"
+#include "syzygy/common/stage_profiler.h"
 #include "syzygy/pdb/pdb_file_stream.h"
+#include "syzygy/pdb/pdb_mapped_stream.h"
 
 namespace pdb {
 
@@ -46,13 +48,39 @@ uint32 GetNumPages(const PdbHeader& header, uint32 num_bytes) {
   return (num_bytes + header.page_size - 1) / header.page_size;
 }
 
+// Creates a stream of the type appropriate to the given file type.
+// @{
+PdbStream* CreateStream(RefCountedFILE* file,
+                        size_t length,
+                        const uint32* pages,
+                        size_t page_size) {
+  return new PdbFileStream(file, length, pages, page_size);
+}
+
+PdbStream* CreateStream(RefCountedMappedFile* file,
+                        size_t length,
+                        const uint32* pages,
+                        size_t page_size) {
+  return new PdbMappedStream(file, length, pages, page_size);
+}
+// @}
+
 }  // namespace
 
 bool PdbReader::Read(const base::FilePath& pdb_path, PdbFile* pdb_file) {
   DCHECK(pdb_file != NULL);
 
+  common::ScopedStageTimer timer("PdbReader::Read");
+
   pdb_file->Clear();
 
+  if (use_memory_mapping_) {
+    scoped_refptr<RefCountedMappedFile> file(new RefCountedMappedFile());
+    if (!file->Init(pdb_path))
+      return false;
+    return ReadImpl(file.get(), file->size(), pdb_file);
+  }
+
   scoped_refptr<RefCountedFILE> file(new RefCountedFILE(
       file_util::OpenFile(pdb_path, "rb")));
   if (!file->file()) {
@@ -67,13 +95,23 @@ bool PdbReader::Read(const base::FilePath& pdb_path, PdbFile* pdb_file) {
     return false;
   }
 
+  return ReadImpl(file.get(), file_size, pdb_file);
+}
+
+template<typename FileType>
+bool PdbReader::ReadImpl(FileType* file,
+                         uint32 file_size,
+                         PdbFile* pdb_file) {
+  DCHECK(file != NULL);
+  DCHECK(pdb_file != NULL);
+
   PdbHeader header = { 0 };
 
   // Read the header from the first page in the file. The page size we use here
   // is irrelevant as after reading the header we get the actual page size in
   // use by the PDB and from then on use that.
   uint32 header_page = 0;
-  scoped_refptr<PdbFileStream> header_stream(new PdbFileStream(
+  scoped_refptr<PdbStream> header_stream(CreateStream(
       file, sizeof(header), &header_page, kPdbPageSize));
   if (!header_stream->Read(&header, 1)) {
     LOG(ERROR) << "Failed to read PDB file header.";
@@ -98,7 +136,7 @@ bool PdbReader::Read(const base::FilePath& pdb_path, PdbFile* pdb_file) {
   // containing that many page pointers from the root pages array.
   int num_dir_pages = static_cast<int>(GetNumPages(header,
                                                    header.directory_size));
-  scoped_refptr<PdbFileStream> dir_page_stream(new PdbFileStream(
+  scoped_refptr<PdbStream> dir_page_stream(CreateStream(
       file, num_dir_pages * sizeof(uint32),
       header.root_pages, header.page_size));
   scoped_ptr<uint32[]> dir_pages(new uint32[num_dir_pages]);
@@ -113,7 +151,7 @@ bool PdbReader::Read(const base::FilePath& pdb_path, PdbFile* pdb_file) {
 
   // Load the actual directory.
   int dir_size = static_cast<int>(header.directory_size / sizeof(uint32));
-  scoped_refptr<PdbFileStream> dir_stream(new PdbFileStream(
+  scoped_refptr<PdbStream> dir_stream(CreateStream(
       file, header.directory_size, dir_pages.get(), header.page_size));
   std::vector<uint32> directory(dir_size);
   if (!dir_stream->Read(&directory[0], dir_size)) {
@@ -128,10 +166,10 @@ bool PdbReader::Read(const base::FilePath& pdb_path, PdbFile* pdb_file) {
 
   uint32 page_index = 0;
   for (uint32 stream_index = 0; stream_index < num_streams; ++stream_index) {
-    pdb_file->AppendStream(new PdbFileStream(file,
-                                             stream_lengths[stream_index],
-                                             stream_pages + page_index,
-                                             header.page_size));
+    pdb_file->AppendStream(CreateStream(file,
+                                        stream_lengths[stream_index],
+                                        stream_pages + page_index,
+                                        header.page_size));
     page_index += GetNumPages(header, stream_lengths[stream_index]);
   }
 
@@ -23,6 +23,7 @@
 #include "syzygy/pdb/pdb_data.h"
 #include "syzygy/pdb/pdb_file.h"
 #include "syzygy/pdb/pdb_file_stream.h"
+#include "syzygy/pdb/pdb_mapped_stream.h"
 #include "syzygy/pdb/pdb_stream.h"
 
 namespace pdb {
@@ -31,7 +32,7 @@ namespace pdb {
 // object with its streams.
 class PdbReader {
  public:
-  PdbReader() { }
+  PdbReader() : use_memory_mapping_(false) { }
 
   // Reads a PDB, populating the given PdbFile object with the streams.
   //
@@ -43,7 +44,28 @@ class PdbReader {
   // @return true on success, false otherwise.
   bool Read(const base::FilePath& pdb_path, PdbFile* pdb_file);
 
+  // Sets whether or not the PDB file is memory mapped. If it is, the streams
+  // are PdbMappedStream objects, which read directly from a single read-only
+  // mapping of the file. Otherwise the streams are PdbFileStream objects,
+  // which read the file a page at a time. Defaults to false.
+  // @param use_memory_mapping true if the PDB file is to be memory mapped.
+  void set_use_memory_mapping(bool use_memory_mapping) {
+    use_memory_mapping_ = use_memory_mapping;
+  }
+
+  // @returns true if PDB files are memory mapped.
+  bool use_memory_mapping() const { return use_memory_mapping_; }
+
  private:
+  // Populates @p pdb_file with the streams found in @p file, which is either
+  // a RefCountedFILE or a RefCountedMappedFile.
+  template<typename FileType>
+  bool ReadImpl(FileType* file,
+                uint32 file_size,
+                PdbFile* pdb_file);
+
+  bool use_memory_mapping_;
+
   DISALLOW_COPY_AND_ASSIGN(PdbReader);
 };
 
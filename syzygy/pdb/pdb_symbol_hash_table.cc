@@ -0,0 +1,432 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pdb/pdb_symbol_hash_table.h"
+
+#include "base/logging.h"
+#include "syzygy/pdb/pdb_constants.h"
+#include "syzygy/pdb/pdb_data.h"
+#include "syzygy/pdb/pdb_file.h"
+#include "syzygy/pdb/pdb_stream.h"
+#include "third_party/cci/Files/CvInfo.h"
+
+namespace cci = Microsoft_Cci_Pdb;
+
+namespace pdb {
+
+namespace {
+
+// The hash table stores the offsets of its buckets in units of the size of
+// the in-memory hash record used by the Microsoft tools, rather than in
+// units of SymbolHashRecord.
+const uint32 kBucketOffsetUnit = 12;
+
+// The number of 32-bit words in the bucket bitmap. There is one bit per
+// bucket, plus an unused one.
+const uint32 kBucketBitmapWords = (kPdbSymbolHashBucketCount + 32) / 32;
+
+// Reads a value of type T at @p *offset in @p data, advancing @p *offset.
+template<typename T>
+bool ReadValue(const std::vector<uint8>& data, size_t end, size_t* offset,
+               T* value) {
+  DCHECK(offset != NULL);
+  DCHECK(value != NULL);
+  DCHECK_LE(end, data.size());
+
+  if (*offset > end || end - *offset < sizeof(T))
+    return false;
+  ::memcpy(value, &data[*offset], sizeof(T));
+  *offset += sizeof(T);
+  return true;
+}
+
+// Skips over a numeric leaf at @p *offset in @p data, advancing @p *offset.
+bool SkipNumericLeaf(const std::vector<uint8>& data, size_t end,
+                     size_t* offset) {
+  uint16 leaf = 0;
+  if (!ReadValue(data, end, offset, &leaf))
+    return false;
+
+  // Values below LF_NUMERIC are stored directly in the leaf.
+  if (leaf < cci::LF_NUMERIC)
+    return true;
+
+  size_t size = 0;
+  switch (leaf) {
+    case cci::LF_CHAR:
+      size = 1;
+      break;
+    case cci::LF_SHORT:
+    case cci::LF_USHORT:
+      size = 2;
+      break;
+    case cci::LF_LONG:
+    case cci::LF_ULONG:
+      size = 4;
+      break;
+    case cci::LF_QUADWORD:
+    case cci::LF_UQUADWORD:
+      size = 8;
+      break;
+    default:
+      return false;
+  }
+
+  if (*offset > end || end - *offset < size)
+    return false;
+  *offset += size;
+  return true;
+}
+
+// @returns the stream of @p pdb_file with the given @p index, or NULL if
+//     there is no such stream.
+scoped_refptr<PdbStream> GetStreamIfPresent(const PdbFile& pdb_file,
+                                            int16 index) {
+  if (index < 0 || static_cast<size_t>(index) >= pdb_file.StreamCount())
+    return NULL;
+  return pdb_file.GetStream(index);
+}
+
+// @returns true if @p bucket is marked as non-empty in @p bitmap.
+bool BucketIsPresent(const std::vector<uint32>& bitmap, uint32 bucket) {
+  return (bitmap[bucket / 32] & (1U << (bucket % 32))) != 0;
+}
+
+}  // namespace
+
+uint32 HashSymbolName(const base::StringPiece& name) {
+  uint32 hash = 0;
+
+  // Fold in the name a 32-bit word at a time, then the remaining half word and
+  // byte, if any.
+  size_t i = 0;
+  for (; i + sizeof(uint32) <= name.size(); i += sizeof(uint32)) {
+    uint32 word = 0;
+    ::memcpy(&word, name.data() + i, sizeof(word));
+    hash ^= word;
+  }
+  if (i + sizeof(uint16) <= name.size()) {
+    uint16 half_word = 0;
+    ::memcpy(&half_word, name.data() + i, sizeof(half_word));
+    hash ^= half_word;
+    i += sizeof(uint16);
+  }
+  if (i < name.size())
+    hash ^= static_cast<uint8>(name[i]);
+
+  // Setting these bits folds upper and lower case ASCII letters together.
+  hash |= 0x20202020;
+  hash ^= hash >> 11;
+  return hash ^ (hash >> 16);
+}
+
+SymbolHashTable::SymbolHashTable() {
+}
+
+bool SymbolHashTable::ReadGlobals(PdbStream* global_symbol_info_stream,
+                                  PdbStream* symbol_record_stream) {
+  DCHECK(global_symbol_info_stream != NULL);
+  DCHECK(symbol_record_stream != NULL);
+
+  address_map_.clear();
+  if (!global_symbol_info_stream->Seek(0) ||
+      !ReadHashTable(global_symbol_info_stream,
+                     global_symbol_info_stream->length())) {
+    LOG(ERROR) << "Unable to read the global symbol hash table.";
+    return false;
+  }
+
+  return ReadSymbolRecords(symbol_record_stream);
+}
+
+bool SymbolHashTable::ReadPublics(PdbStream* public_symbol_info_stream,
+                                  PdbStream* symbol_record_stream) {
+  DCHECK(public_symbol_info_stream != NULL);
+  DCHECK(symbol_record_stream != NULL);
+
+  PublicSymbolHashHeader header = {};
+  if (!public_symbol_info_stream->Seek(0) ||
+      !public_symbol_info_stream->Read(&header, 1)) {
+    LOG(ERROR) << "Unable to read the public symbol info header.";
+    return false;
+  }
+
+  if (!ReadHashTable(public_symbol_info_stream, header.symbol_hash_size)) {
+    LOG(ERROR) << "Unable to read the public symbol hash table.";
+    return false;
+  }
+
+  // The address map immediately follows the hash table.
+  address_map_.clear();
+  if (header.address_map_size % sizeof(uint32) != 0 ||
+      !public_symbol_info_stream->Read(
+          &address_map_, header.address_map_size / sizeof(uint32))) {
+    LOG(ERROR) << "Unable to read the public symbol address map.";
+    return false;
+  }
+
+  return ReadSymbolRecords(symbol_record_stream);
+}
+
+bool SymbolHashTable::Find(const base::StringPiece& name,
+                           HashedSymbols* symbols) const {
+  DCHECK(symbols != NULL);
+
+  if (bucket_starts_.empty())
+    return true;
+
+  uint32 bucket = HashSymbolName(name) % kPdbSymbolHashBucketCount;
+  for (uint32 i = bucket_starts_[bucket]; i < bucket_starts_[bucket + 1];
+       ++i) {
+    HashedSymbol symbol = {};
+    if (!ParseSymbol(record_offsets_[i], &symbol))
+      return false;
+    if (symbol.name == name)
+      symbols->push_back(symbol);
+  }
+
+  return true;
+}
+
+bool SymbolHashTable::GetSymbolsByAddress(HashedSymbols* symbols) const {
+  DCHECK(symbols != NULL);
+
+  symbols->reserve(symbols->size() + address_map_.size());
+  for (size_t i = 0; i < address_map_.size(); ++i) {
+    HashedSymbol symbol = {};
+    if (!ParseSymbol(address_map_[i], &symbol))
+      return false;
+    symbols->push_back(symbol);
+  }
+
+  return true;
+}
+
+bool SymbolHashTable::ReadHashTable(PdbStream* stream, size_t size) {
+  DCHECK(stream != NULL);
+
+  record_offsets_.clear();
+  bucket_starts_.clear();
+
+  size_t end = stream->pos() + size;
+  if (end > stream->length())
+    return false;
+
+  SymbolHashHeader header = {};
+  if (!stream->Read(&header, 1))
+    return false;
+  if (header.signature != kPdbSymbolHashSignature ||
+      header.version != kPdbSymbolHashVersion) {
+    LOG(ERROR) << "Unexpected symbol hash table version.";
+    return false;
+  }
+  if (header.hash_records_size % sizeof(SymbolHashRecord) != 0)
+    return false;
+
+  std::vector<SymbolHashRecord> records;
+  if (!stream->Read(&records,
+                    header.hash_records_size / sizeof(SymbolHashRecord))) {
+    return false;
+  }
+
+  // An empty table has no buckets at all.
+  if (header.buckets_size == 0) {
+    bucket_starts_.resize(kPdbSymbolHashBucketCount + 1, 0);
+    return records.empty() && stream->pos() <= end;
+  }
+
+  std::vector<uint32> bitmap;
+  if (!stream->Read(&bitmap, kBucketBitmapWords))
+    return false;
+
+  // There is an offset for each bucket whose bit is set.
+  size_t bucket_count = 0;
+  for (uint32 i = 0; i < kPdbSymbolHashBucketCount; ++i) {
+    if (BucketIsPresent(bitmap, i))
+      ++bucket_count;
+  }
+  std::vector<uint32> buckets;
+  if ((kBucketBitmapWords + bucket_count) * sizeof(uint32) !=
+          header.buckets_size ||
+      !stream->Read(&buckets, bucket_count)) {
+    return false;
+  }
+  if (stream->pos() > end)
+    return false;
+
+  // Walk the buckets backwards so that empty buckets can start where the next
+  // one does.
+  bucket_starts_.resize(kPdbSymbolHashBucketCount + 1);
+  uint32 next_start = static_cast<uint32>(records.size());
+  bucket_starts_[kPdbSymbolHashBucketCount] = next_start;
+  for (uint32 i = kPdbSymbolHashBucketCount; i > 0; --i) {
+    uint32 bucket = i - 1;
+    if (BucketIsPresent(bitmap, bucket)) {
+      DCHECK_LT(0U, bucket_count);
+      uint32 start = buckets[--bucket_count] / kBucketOffsetUnit;
+      if (start > next_start) {
+        LOG(ERROR) << "Symbol hash buckets are out of order.";
+        bucket_starts_.clear();
+        return false;
+      }
+      next_start = start;
+    }
+    bucket_starts_[bucket] = next_start;
+  }
+
+  record_offsets_.reserve(records.size());
+  for (size_t i = 0; i < records.size(); ++i) {
+    if (records[i].offset == 0) {
+      LOG(ERROR) << "Invalid symbol hash record.";
+      bucket_starts_.clear();
+      record_offsets_.clear();
+      return false;
+    }
+    record_offsets_.push_back(records[i].offset - 1);
+  }
+
+  return true;
+}
+
+bool SymbolHashTable::ReadSymbolRecords(PdbStream* stream) {
+  DCHECK(stream != NULL);
+
+  symbol_records_.clear();
+  if (!stream->Seek(0) || !stream->Read(&symbol_records_, stream->length())) {
+    LOG(ERROR) << "Unable to read the symbol record stream.";
+    return false;
+  }
+
+  return true;
+}
+
+bool SymbolHashTable::ParseSymbol(uint32 record_offset,
+                                  HashedSymbol* symbol) const {
+  DCHECK(symbol != NULL);
+
+  size_t offset = record_offset;
+  uint16 length = 0;
+  uint16 type = 0;
+  if (!ReadValue(symbol_records_, symbol_records_.size(), &offset, &length))
+    return false;
+  size_t end = offset + length;
+  if (end > symbol_records_.size() ||
+      !ReadValue(symbol_records_, end, &offset, &type)) {
+    LOG(ERROR) << "Invalid symbol record at offset " << record_offset << ".";
+    return false;
+  }
+
+  symbol->record_offset = record_offset;
+  symbol->type = type;
+  symbol->segment = 0;
+  symbol->offset = 0;
+
+  uint32 type_index = 0;
+  bool parsed = false;
+  switch (type) {
+    // These all share the layout of DatasSym32, with flags in place of the
+    // type index for public symbols.
+    case cci::S_PUB32:
+    case cci::S_LDATA32:
+    case cci::S_GDATA32:
+    case cci::S_LTHREAD32:
+    case cci::S_GTHREAD32:
+      parsed = ReadValue(symbol_records_, end, &offset, &type_index) &&
+          ReadValue(symbol_records_, end, &offset, &symbol->offset) &&
+          ReadValue(symbol_records_, end, &offset, &symbol->segment);
+      break;
+
+    // These have the layout of RefSym2.
+    case cci::S_PROCREF:
+    case cci::S_DATAREF:
+    case cci::S_LPROCREF: {
+      uint32 name_checksum = 0;
+      parsed = ReadValue(symbol_records_, end, &offset, &name_checksum) &&
+          ReadValue(symbol_records_, end, &offset, &symbol->offset) &&
+          ReadValue(symbol_records_, end, &offset, &symbol->segment);
+      break;
+    }
+
+    case cci::S_UDT:
+      parsed = ReadValue(symbol_records_, end, &offset, &type_index);
+      break;
+
+    case cci::S_CONSTANT:
+      parsed = ReadValue(symbol_records_, end, &offset, &type_index) &&
+          SkipNumericLeaf(symbol_records_, end, &offset);
+      break;
+
+    default:
+      // Other records have no name we know how to find.
+      return false;
+  }
+
+  if (!parsed) {
+    LOG(ERROR) << "Invalid symbol record at offset " << record_offset << ".";
+    return false;
+  }
+
+  // The name is zero terminated, but may also run to the end of the record.
+  const char* name = reinterpret_cast<const char*>(&symbol_records_[0]) +
+      offset;
+  size_t name_length = 0;
+  while (offset + name_length < end && name[name_length] != '\0')
+    ++name_length;
+  symbol->name.assign(name, name_length);
+
+  return true;
+}
+
+bool ReadSymbolHashTables(const PdbFile& pdb_file,
+                          SymbolHashTable* globals,
+                          SymbolHashTable* publics) {
+  scoped_refptr<PdbStream> dbi_stream(
+      GetStreamIfPresent(pdb_file, kDbiStream));
+  DbiHeader dbi_header = {};
+  if (dbi_stream.get() == NULL || !dbi_stream->Read(&dbi_header, 1)) {
+    LOG(ERROR) << "Unable to read the Dbi header.";
+    return false;
+  }
+
+  scoped_refptr<PdbStream> symbol_records(
+      GetStreamIfPresent(pdb_file, dbi_header.symbol_record_stream));
+  if (symbol_records.get() == NULL) {
+    LOG(ERROR) << "The PDB has no symbol record stream.";
+    return false;
+  }
+
+  if (globals != NULL) {
+    scoped_refptr<PdbStream> stream(
+        GetStreamIfPresent(pdb_file, dbi_header.global_symbol_info_stream));
+    if (stream.get() == NULL ||
+        !globals->ReadGlobals(stream.get(), symbol_records.get())) {
+      LOG(ERROR) << "Unable to read the global symbol info stream.";
+      return false;
+    }
+  }
+
+  if (publics != NULL) {
+    scoped_refptr<PdbStream> stream(
+        GetStreamIfPresent(pdb_file, dbi_header.public_symbol_info_stream));
+    if (stream.get() == NULL ||
+        !publics->ReadPublics(stream.get(), symbol_records.get())) {
+      LOG(ERROR) << "Unable to read the public symbol info stream.";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+}  // namespace pdb
@@ -0,0 +1,149 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a reader for the global and public symbol hash tables of a PDB.
+// These tables index the records of the symbol record stream by name, and
+// allow looking up a global or public symbol without visiting every record.
+// The public symbol info stream additionally provides an address map, which
+// lists the public symbols sorted by address.
+
+#ifndef SYZYGY_PDB_PDB_SYMBOL_HASH_TABLE_H_
+#define SYZYGY_PDB_PDB_SYMBOL_HASH_TABLE_H_
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/string_piece.h"
+
+namespace pdb {
+
+// Forward declarations.
+class PdbFile;
+class PdbStream;
+
+// Describes a symbol record found via a symbol hash table.
+struct HashedSymbol {
+  // The offset of the symbol record in the symbol record stream. This points
+  // at the record's length.
+  uint32 record_offset;
+  // The type of the symbol record. This is one of the S_* constants.
+  uint16 type;
+  // The section and offset of the symbol, for public, data and thread storage
+  // symbols. For procedure and data references these are instead the index of
+  // the module containing the referenced symbol and the offset of that symbol
+  // in the module's symbol stream. Both are zero for other symbols.
+  uint16 segment;
+  uint32 offset;
+  // The name of the symbol.
+  std::string name;
+};
+typedef std::vector<HashedSymbol> HashedSymbols;
+
+// Computes the hash of a symbol name, as used for bucketing names in the
+// symbol hash tables. The hash is not case sensitive for ASCII letters.
+// @param name the name to hash.
+// @returns the hash of @p name. This needs to be reduced modulo the number of
+//     buckets in the table.
+uint32 HashSymbolName(const base::StringPiece& name);
+
+// A symbol hash table. This holds the hash table itself along with the
+// contents of the symbol record stream it refers to.
+class SymbolHashTable {
+ public:
+  SymbolHashTable();
+
+  // Reads a global symbol hash table.
+  // @param global_symbol_info_stream the global symbol info stream.
+  // @param symbol_record_stream the symbol record stream.
+  // @returns true on success, false otherwise.
+  bool ReadGlobals(PdbStream* global_symbol_info_stream,
+                   PdbStream* symbol_record_stream);
+
+  // Reads a public symbol hash table, and its address map.
+  // @param public_symbol_info_stream the public symbol info stream.
+  // @param symbol_record_stream the symbol record stream.
+  // @returns true on success, false otherwise.
+  bool ReadPublics(PdbStream* public_symbol_info_stream,
+                   PdbStream* symbol_record_stream);
+
+  // Finds the symbols with a given name. This only inspects the symbols that
+  // share the bucket of @p name.
+  // @param name the name to look for. The match is case sensitive.
+  // @param symbols receives the matching symbols, in table order.
+  // @returns true on success, false if the table refers to malformed symbol
+  //     records.
+  bool Find(const base::StringPiece& name, HashedSymbols* symbols) const;
+
+  // Gets the public symbols, sorted by address.
+  // @param symbols receives the symbols.
+  // @returns true on success, false if the table refers to malformed symbol
+  //     records.
+  // @pre ReadPublics has succeeded.
+  bool GetSymbolsByAddress(HashedSymbols* symbols) const;
+
+  // @returns the number of symbols in the table.
+  size_t size() const { return record_offsets_.size(); }
+
+ private:
+  // Reads the hash table, which must be positioned at the stream's current
+  // position.
+  // @param stream the stream containing the table.
+  // @param size the size of the table, in bytes.
+  // @returns true on success, false otherwise.
+  bool ReadHashTable(PdbStream* stream, size_t size);
+
+  // Reads the content of the symbol record stream.
+  // @param stream the symbol record stream.
+  // @returns true on success, false otherwise.
+  bool ReadSymbolRecords(PdbStream* stream);
+
+  // Parses the symbol record at a given offset.
+  // @param record_offset the offset of the record.
+  // @param symbol receives the parsed symbol.
+  // @returns true on success, false if the record is malformed or of a type
+  //     without a name.
+  bool ParseSymbol(uint32 record_offset, HashedSymbol* symbol) const;
+
+  // The content of the symbol record stream.
+  std::vector<uint8> symbol_records_;
+
+  // The offset of each hashed symbol in the symbol record stream, grouped by
+  // bucket.
+  std::vector<uint32> record_offsets_;
+
+  // The index in record_offsets_ of the first symbol of each bucket. This has
+  // one more entry than there are buckets, so that each bucket extends to the
+  // start of the next.
+  std::vector<uint32> bucket_starts_;
+
+  // The offsets of the public symbols in the symbol record stream, sorted by
+  // address. Only populated by ReadPublics.
+  std::vector<uint32> address_map_;
+
+  DISALLOW_COPY_AND_ASSIGN(SymbolHashTable);
+};
+
+// Reads the global and public symbol hash tables of a PDB file.
+// @param pdb_file the PDB file to read.
+// @param globals receives the global symbol hash table. May be NULL.
+// @param publics receives the public symbol hash table. May be NULL.
+// @returns true on success, false otherwise.
+bool ReadSymbolHashTables(const PdbFile& pdb_file,
+                          SymbolHashTable* globals,
+                          SymbolHashTable* publics);
+
+}  // namespace pdb
+
+#endif  // SYZYGY_PDB_PDB_SYMBOL_HASH_TABLE_H_
@@ -0,0 +1,100 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pdb/pdb_symbol_hash_table.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/pdb/pdb_file.h"
+#include "syzygy/pdb/pdb_reader.h"
+#include "syzygy/pdb/unittest_util.h"
+#include "third_party/cci/Files/CvInfo.h"
+
+namespace pdb {
+
+namespace {
+
+namespace cci = Microsoft_Cci_Pdb;
+
+class SymbolHashTableTest : public testing::Test {
+ public:
+  virtual void SetUp() {
+    PdbReader reader;
+    ASSERT_TRUE(reader.Read(
+        testing::GetSrcRelativePath(testing::kTestPdbFilePath), &pdb_file_));
+  }
+
+ protected:
+  PdbFile pdb_file_;
+};
+
+}  // namespace
+
+TEST(HashSymbolNameTest, IgnoresCase) {
+  EXPECT_EQ(HashSymbolName("a"), HashSymbolName("A"));
+  EXPECT_EQ(HashSymbolName("_DllMain@12"), HashSymbolName("_dllmain@12"));
+  EXPECT_EQ(HashSymbolName(""), HashSymbolName(""));
+}
+
+TEST_F(SymbolHashTableTest, ReadGlobals) {
+  SymbolHashTable globals;
+  ASSERT_TRUE(ReadSymbolHashTables(pdb_file_, &globals, NULL));
+  EXPECT_LT(0u, globals.size());
+
+  // Only the public symbol info stream has an address map.
+  HashedSymbols symbols;
+  EXPECT_TRUE(globals.GetSymbolsByAddress(&symbols));
+  EXPECT_TRUE(symbols.empty());
+}
+
+TEST_F(SymbolHashTableTest, FindPublics) {
+  SymbolHashTable publics;
+  ASSERT_TRUE(ReadSymbolHashTables(pdb_file_, NULL, &publics));
+
+  HashedSymbols by_address;
+  ASSERT_TRUE(publics.GetSymbolsByAddress(&by_address));
+  ASSERT_FALSE(by_address.empty());
+  EXPECT_EQ(publics.size(), by_address.size());
+
+  for (size_t i = 0; i < by_address.size(); ++i) {
+    const HashedSymbol& symbol = by_address[i];
+    EXPECT_EQ(cci::S_PUB32, symbol.type);
+    EXPECT_FALSE(symbol.name.empty());
+
+    // The address map is sorted by address.
+    if (i > 0) {
+      const HashedSymbol& previous = by_address[i - 1];
+      EXPECT_TRUE(previous.segment < symbol.segment ||
+                  (previous.segment == symbol.segment &&
+                   previous.offset <= symbol.offset));
+    }
+
+    // Each public symbol can be found by name.
+    HashedSymbols found;
+    ASSERT_TRUE(publics.Find(symbol.name, &found));
+    bool found_symbol = false;
+    for (size_t j = 0; j < found.size(); ++j) {
+      EXPECT_EQ(symbol.name, found[j].name);
+      if (found[j].record_offset == symbol.record_offset)
+        found_symbol = true;
+    }
+    EXPECT_TRUE(found_symbol);
+  }
+
+  HashedSymbols found;
+  EXPECT_TRUE(publics.Find("this symbol does not exist", &found));
+  EXPECT_TRUE(found.empty());
+}
+
+}  // namespace pdb
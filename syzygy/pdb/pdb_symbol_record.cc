@@ -15,6 +15,7 @@
 #include "syzygy/pdb/pdb_symbol_record.h"
 
 #include <string>
+#include <vector>
 
 #include "base/stringprintf.h"
 #include "syzygy/common/align.h"
@@ -39,29 +40,41 @@ bool ReadSymbolRecord(PdbStream* stream,
     return false;
   }
 
+  // Read the symbol table at once, rather than record by record, and locate
+  // the records in memory.
+  size_t table_start = stream->pos();
+  std::vector<uint8> table(symbol_table_size);
+  if (!table.empty() && !stream->Read(&table[0], table.size())) {
+    LOG(ERROR) << "Unable to read the symbol table.";
+    return false;
+  }
+
   // Process each symbol present in the stream. For now we only save their
   // starting positions, their lengths and their types to be able to dump them.
-  while (stream->pos() < stream_end) {
+  size_t offset = 0;
+  while (offset < table.size()) {
     uint16 len = 0;
     uint16 symbol_type = 0;
-    if (!stream->Read(&len, 1)) {
-      LOG(ERROR) << "Unable to read a symbol record length.";
+    if (table.size() - offset < sizeof(len) + sizeof(symbol_type)) {
+      LOG(ERROR) << "Unable to read a symbol record header.";
       return false;
     }
-    size_t symbol_start = stream->pos();
-    if (!stream->Read(&symbol_type, 1))  {
-      LOG(ERROR) << "Unable to read a symbol record type.";
+    ::memcpy(&len, &table[offset], sizeof(len));
+    ::memcpy(&symbol_type, &table[offset + sizeof(len)], sizeof(symbol_type));
+    offset += sizeof(len);
+
+    if (len < sizeof(symbol_type) || len > table.size() - offset) {
+      LOG(ERROR) << "Invalid symbol record length.";
       return false;
     }
+
     SymbolRecord sym_record;
     sym_record.type = symbol_type;
-    sym_record.start_position = stream->pos();
+    sym_record.start_position = table_start + offset + sizeof(symbol_type);
     sym_record.len = len - sizeof(symbol_type);
     symbol_vector->push_back(sym_record);
-    if (stream->pos() != stream_end && !stream->Seek(symbol_start + len)) {
-      LOG(ERROR) << "Unable to seek to the end of the symbol record.";
-      return false;
-    }
+
+    offset += len;
   }
 
   return true;
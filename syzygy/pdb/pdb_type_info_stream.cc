@@ -21,69 +21,113 @@
 
 namespace pdb {
 
-bool ReadTypeInfoStream(PdbStream* stream,
-                        TypeInfoHeader* type_info_header,
-                        TypeInfoRecordMap* type_info_record_map) {
+TypeInfoIndex::TypeInfoIndex() {
+  ::memset(&header_, 0, sizeof(header_));
+}
+
+bool TypeInfoIndex::Init(PdbStream* stream) {
   DCHECK(stream != NULL);
-  DCHECK(type_info_header != NULL);
-  DCHECK(type_info_record_map != NULL);
+  DCHECK(records_.empty());
 
   // Reads the header of the stream.
-  if (!stream->Seek(0) || !stream->Read(type_info_header, 1)) {
+  if (!stream->Seek(0) || !stream->Read(&header_, 1)) {
     LOG(ERROR) << "Unable to read the type info stream header.";
     return false;
   }
 
-  if (stream->pos() != type_info_header->len) {
+  if (stream->pos() != header_.len) {
     LOG(ERROR) << "Unexpected length for the type info stream header (expected "
-               << type_info_header->len << ", read " << stream->pos() << ").";
+               << header_.len << ", read " << stream->pos() << ").";
     return false;
   }
 
-  size_t type_info_data_end =
-      type_info_header->len + type_info_header->type_info_data_size;
+  size_t type_info_data_end = header_.len + header_.type_info_data_size;
 
   if (type_info_data_end != stream->length()) {
     LOG(ERROR) << "The type info stream is not valid.";
     return false;
   }
 
+  // Read all of the type info data at once, rather than record by record.
+  data_.resize(header_.type_info_data_size);
+  if (!data_.empty() && !stream->Read(&data_[0], data_.size())) {
+    LOG(ERROR) << "Unable to read the type info records.";
+    return false;
+  }
+
   // The type ID of each entry is not present in the stream, instead of that we
   // know the first and the last type ID and we know that the type records are
-  // ordered in increasing order in the stream.
-  uint32 current_type_id = type_info_header->type_min;
-  // Process each type record present in the stream. For now we only save their
-  // starting positions, their lengths and their types to be able to dump them.
-  while (stream->pos() < type_info_data_end) {
+  // ordered in increasing order in the stream. We save the starting position,
+  // the length and the type of each record.
+  if (header_.type_max > header_.type_min)
+    records_.reserve(header_.type_max - header_.type_min);
+  size_t offset = 0;
+  while (offset < data_.size()) {
     uint16 len = 0;
     uint16 record_type = 0;
-    if (!stream->Read(&len, 1)) {
-      LOG(ERROR) << "Unable to read a type info record length.";
+    if (data_.size() - offset < sizeof(len) + sizeof(record_type)) {
+      LOG(ERROR) << "Unable to read a type info record header.";
       return false;
     }
-    size_t symbol_start = stream->pos();
-    if (!stream->Read(&record_type, 1))  {
-      LOG(ERROR) << "Unable to read a type info record type.";
+    ::memcpy(&len, &data_[offset], sizeof(len));
+    ::memcpy(&record_type, &data_[offset + sizeof(len)], sizeof(record_type));
+    offset += sizeof(len);
+
+    if (len < sizeof(record_type) || len > data_.size() - offset) {
+      LOG(ERROR) << "Invalid type info record length.";
       return false;
     }
+
     TypeInfoRecord type_record;
     type_record.type = record_type;
-    type_record.start_position = stream->pos();
+    type_record.start_position = header_.len + offset + sizeof(record_type);
     type_record.len = len - sizeof(record_type);
+    records_.push_back(type_record);
 
-    type_info_record_map->insert(std::make_pair(current_type_id, type_record));
-    if (!stream->Seek(symbol_start + len)) {
-      LOG(ERROR) << "Unable to seek to the end of the type info record.";
-      return false;
-    }
-    current_type_id++;
+    offset += len;
   }
 
-  if (current_type_id != type_info_header->type_max) {
+  if (header_.type_min + records_.size() != header_.type_max) {
     LOG(ERROR) << "Unexpected number of type info records in the type info "
-               << "stream (expected " << type_info_header->type_max
-               - type_info_header->type_min << ", read " << current_type_id
-               - type_info_header->type_min << ").";
+               << "stream (expected " << header_.type_max - header_.type_min
+               << ", read " << records_.size() << ").";
+  }
+
+  return true;
+}
+
+const TypeInfoRecord* TypeInfoIndex::GetRecord(uint32 type_id) const {
+  if (type_id < header_.type_min ||
+      type_id - header_.type_min >= records_.size()) {
+    return NULL;
+  }
+  return &records_[type_id - header_.type_min];
+}
+
+const uint8* TypeInfoIndex::GetRecordData(uint32 type_id) const {
+  const TypeInfoRecord* record = GetRecord(type_id);
+  if (record == NULL)
+    return NULL;
+  return &data_[0] + (record->start_position - header_.len);
+}
+
+bool ReadTypeInfoStream(PdbStream* stream,
+                        TypeInfoHeader* type_info_header,
+                        TypeInfoRecordMap* type_info_record_map) {
+  DCHECK(stream != NULL);
+  DCHECK(type_info_header != NULL);
+  DCHECK(type_info_record_map != NULL);
+
+  TypeInfoIndex index;
+  if (!index.Init(stream))
+    return false;
+
+  *type_info_header = index.header();
+  uint32 type_id = index.header().type_min;
+  for (size_t i = 0; i < index.record_count(); ++i, ++type_id) {
+    type_info_record_map->insert(type_info_record_map->end(),
+                                 std::make_pair(type_id,
+                                                *index.GetRecord(type_id)));
   }
 
   return true;
@@ -28,6 +28,55 @@ namespace pdb {
 // Forward declarations.
 class PdbStream;
 
+// An index of the records of a type info stream. The record data is read into
+// memory with a single read, and the records are located with one pass over
+// it. After that any record can be looked up by its type ID in constant time,
+// and its data decoded on demand without going back to the stream. The index
+// is immutable once initialized, so records can be decoded concurrently from
+// several threads. Sample usage:
+//
+//   TypeInfoIndex index;
+//   if (!index.Init(stream))
+//     return false;
+//   const TypeInfoRecord* record = index.GetRecord(type_id);
+//   const uint8* data = index.GetRecordData(type_id);
+class TypeInfoIndex {
+ public:
+  TypeInfoIndex();
+
+  // Reads the header and indexes the records of a type info stream.
+  // @param stream the type info stream.
+  // @returns true on success, false if the stream is invalid.
+  bool Init(PdbStream* stream);
+
+  // @returns the header of the type info stream.
+  const TypeInfoHeader& header() const { return header_; }
+
+  // @returns the number of type info records.
+  size_t record_count() const { return records_.size(); }
+
+  // @returns the record of the type with ID @p type_id, or NULL if there is
+  //     none.
+  const TypeInfoRecord* GetRecord(uint32 type_id) const;
+
+  // @returns the data of the record of the type with ID @p type_id, following
+  //     its type, or NULL if there is none. The data is GetRecord()->len bytes
+  //     long.
+  const uint8* GetRecordData(uint32 type_id) const;
+
+ private:
+  // The header of the stream.
+  TypeInfoHeader header_;
+
+  // The type info records, indexed by type ID less header_.type_min.
+  std::vector<TypeInfoRecord> records_;
+
+  // The type info data, which starts at position header_.len of the stream.
+  std::vector<uint8> data_;
+
+  DISALLOW_COPY_AND_ASSIGN(TypeInfoIndex);
+};
+
 // Read @p type_info_header and @p type_info_record_map from @p stream.
 bool ReadTypeInfoStream(PdbStream* stream,
                         TypeInfoHeader* type_info_header,
@@ -61,4 +61,62 @@ TEST(PdbTypeInfoStreamTest, ReadInvalidHeaderTypeInfoStream) {
                                   &types_map));
 }
 
+TEST(PdbTypeInfoStreamTest, IndexValidTypeInfoStream) {
+  base::FilePath valid_type_info_path = testing::GetSrcRelativePath(
+      testing::kValidPdbTypeInfoStreamPath);
+
+  scoped_refptr<pdb::PdbFileStream> valid_type_info_stream =
+      testing::GetStreamFromFile(valid_type_info_path);
+  TypeInfoIndex index;
+  ASSERT_TRUE(index.Init(valid_type_info_stream.get()));
+
+  const TypeInfoHeader& header = index.header();
+  ASSERT_EQ(header.type_max - header.type_min, index.record_count());
+  EXPECT_TRUE(index.GetRecord(header.type_min - 1) == NULL);
+  EXPECT_TRUE(index.GetRecord(header.type_max) == NULL);
+  EXPECT_TRUE(index.GetRecordData(header.type_max) == NULL);
+
+  // The index must agree with the record map.
+  TypeInfoHeader map_header;
+  TypeInfoRecordMap types_map;
+  ASSERT_TRUE(ReadTypeInfoStream(valid_type_info_stream.get(),
+                                 &map_header,
+                                 &types_map));
+  ASSERT_EQ(index.record_count(), types_map.size());
+
+  std::vector<uint8> data;
+  TypeInfoRecordMap::const_iterator it = types_map.begin();
+  for (; it != types_map.end(); ++it) {
+    const TypeInfoRecord* record = index.GetRecord(it->first);
+    ASSERT_TRUE(record != NULL);
+    EXPECT_EQ(it->second.type, record->type);
+    EXPECT_EQ(it->second.start_position, record->start_position);
+    EXPECT_EQ(it->second.len, record->len);
+
+    // The data of the record must match the content of the stream.
+    if (record->len == 0)
+      continue;
+    data.resize(record->len);
+    ASSERT_TRUE(valid_type_info_stream->Seek(record->start_position));
+    ASSERT_TRUE(valid_type_info_stream->Read(&data[0], data.size()));
+    const uint8* record_data = index.GetRecordData(it->first);
+    ASSERT_TRUE(record_data != NULL);
+    EXPECT_EQ(0, ::memcmp(&data[0], record_data, data.size()));
+  }
+}
+
+TEST(PdbTypeInfoStreamTest, IndexInvalidTypeInfoStreams) {
+  scoped_refptr<pdb::PdbFileStream> invalid_data_stream =
+      testing::GetStreamFromFile(testing::GetSrcRelativePath(
+          testing::kInvalidDataPdbTypeInfoStreamPath));
+  TypeInfoIndex invalid_data_index;
+  EXPECT_FALSE(invalid_data_index.Init(invalid_data_stream.get()));
+
+  scoped_refptr<pdb::PdbFileStream> invalid_header_stream =
+      testing::GetStreamFromFile(testing::GetSrcRelativePath(
+          testing::kInvalidHeaderPdbTypeInfoStreamPath));
+  TypeInfoIndex invalid_header_index;
+  EXPECT_FALSE(invalid_header_index.Init(invalid_header_stream.get()));
+}
+
 }  // namespace pdb
@@ -18,7 +18,9 @@
 
 #include "base/stringprintf.h"
 #include "sawbuck/common/buffer_parser.h"
+#include "syzygy/pdb/omap.h"
 #include "syzygy/pdb/pdb_byte_stream.h"
+#include "syzygy/pdb/pdb_dbi_stream.h"
 #include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/pdb_writer.h"
 
@@ -190,6 +192,40 @@ struct NamedStreamInfo {
   uint32 bucket;
 };
 
+// Reads the Dbi debug header of a PDB file.
+bool ReadDbiDbgHeader(const PdbFile& pdb_file, DbiDbgHeader* dbg_header) {
+  DCHECK(dbg_header != NULL);
+
+  scoped_refptr<PdbStream> dbi_stream = pdb_file.GetStream(kDbiStream);
+  DbiHeader dbi_header = {};
+  if (dbi_stream.get() == NULL ||
+      !dbi_stream->Seek(0) ||
+      !dbi_stream->Read(&dbi_header, 1) ||
+      !dbi_stream->Seek(GetDbiDbgHeaderOffset(dbi_header)) ||
+      !dbi_stream->Read(dbg_header, 1)) {
+    LOG(ERROR) << "Failed to read Dbi debug header.";
+    return false;
+  }
+
+  return true;
+}
+
+// Reads the whole of a stream referred to by the Dbi debug header.
+// @returns false if the stream doesn't exist or can't be read.
+template <typename ItemType>
+bool ReadDbgStream(const PdbFile& pdb_file,
+                   int16 index,
+                   std::vector<ItemType>* items) {
+  DCHECK(items != NULL);
+
+  if (index < 0)
+    return false;
+  scoped_refptr<PdbStream> stream = pdb_file.GetStream(index);
+  if (stream.get() == NULL)
+    return false;
+  return stream->Seek(0) && stream->Read(items);
+}
+
 }  // namespace
 
 bool PdbBitSet::Read(PdbStream* stream) {
@@ -294,6 +330,79 @@ uint32 GetDbiDbgHeaderOffset(const DbiHeader& dbi_header) {
   return offset;
 }
 
+bool ReadFixupsFromPdbFile(const PdbFile& pdb_file,
+                           std::vector<PdbFixup>* fixups) {
+  DCHECK(fixups != NULL);
+
+  DbiDbgHeader dbg_header = {};
+  if (!ReadDbiDbgHeader(pdb_file, &dbg_header))
+    return false;
+
+  if (!ReadDbgStream(pdb_file, dbg_header.fixup, fixups)) {
+    LOG(ERROR) << "Failed to read FIXUP stream.";
+    return false;
+  }
+
+  return true;
+}
+
+bool ReadSectionContribsFromPdbFile(
+    const PdbFile& pdb_file,
+    const DbiStream& dbi_stream,
+    std::vector<ImageSectionContrib>* section_contribs) {
+  DCHECK(section_contribs != NULL);
+
+  section_contribs->clear();
+  const DbiDbgHeader& dbg_header = dbi_stream.dbg_header();
+
+  // If the image has been transformed the contributions are expressed
+  // relative to the original section headers.
+  std::vector<OMAP> omap_from;
+  int16 section_header_index = dbg_header.section_header;
+  if (dbg_header.omap_from_src >= 0) {
+    if (!ReadDbgStream(pdb_file, dbg_header.omap_from_src, &omap_from)) {
+      LOG(ERROR) << "Failed to read OMAP_FROM stream.";
+      return false;
+    }
+    section_header_index = dbg_header.section_header_origin;
+  }
+
+  std::vector<IMAGE_SECTION_HEADER> section_headers;
+  if (!ReadDbgStream(pdb_file, section_header_index, &section_headers)) {
+    LOG(ERROR) << "Failed to read section header stream.";
+    return false;
+  }
+
+  OmapTranslator omap_translator;
+  omap_translator.Init(omap_from);
+
+  const DbiStream::DbiSectionContribVector& contribs =
+      dbi_stream.section_contribs();
+  section_contribs->reserve(contribs.size());
+  for (size_t i = 0; i < contribs.size(); ++i) {
+    const DbiSectionContrib& contrib = contribs[i];
+
+    // Sections are numbered from 1 to n in the PDB.
+    if (contrib.section < 1 ||
+        static_cast<size_t>(contrib.section) > section_headers.size()) {
+      LOG(ERROR) << "Section contribution refers to invalid section "
+                 << contrib.section << ".";
+      return false;
+    }
+
+    const IMAGE_SECTION_HEADER& header = section_headers[contrib.section - 1];
+    core::RelativeAddress rva(header.VirtualAddress + contrib.offset);
+    ImageSectionContrib image_contrib = {
+        omap_translator.Translate(rva),
+        contrib.size,
+        contrib.flags,
+        contrib.module };
+    section_contribs->push_back(image_contrib);
+  }
+
+  return true;
+}
+
 bool EnsureStreamWritable(uint32 index, PdbFile* pdb_file) {
   DCHECK(pdb_file != NULL);
 
@@ -21,12 +21,14 @@
 #include <vector>
 
 #include "base/files/file_path.h"
+#include "syzygy/core/address.h"
 #include "syzygy/pdb/pdb_data.h"
 #include "syzygy/pdb/pdb_stream.h"
 
 namespace pdb {
 
 // Forward declare.
+class DbiStream;
 class PdbFile;
 class PdbStream;
 class WritablePdbStream;
@@ -83,6 +85,41 @@ class PdbBitSet {
 // @returns the offset in the DBI stream of the DbiDbgHeader, in bytes.
 uint32 GetDbiDbgHeaderOffset(const DbiHeader& dbi_header);
 
+// Reads the FIXUP stream of a PDB file as a flat array, in a single pass. This
+// bypasses DIA, which hands out the same records one at a time.
+// @param pdb_file the PDB file to read.
+// @param fixups receives the fixups.
+// @returns true on success, false if the PDB file has no FIXUP stream or if
+//     it could not be read.
+bool ReadFixupsFromPdbFile(const PdbFile& pdb_file,
+                           std::vector<PdbFixup>* fixups);
+
+// A section contribution, with its address resolved in the final image.
+struct ImageSectionContrib {
+  // The address of the contribution in the image.
+  core::RelativeAddress rva;
+  // The length of the contribution, in bytes.
+  size_t length;
+  // The IMAGE_SCN_* characteristics of the contribution.
+  uint32 characteristics;
+  // The index of the contributing module in the Dbi stream.
+  size_t module;
+};
+
+// Reads the section contributions of a PDB file as a flat array, resolving
+// their addresses in the image. If the image has been transformed then the
+// contributions are relative to the original section headers, and are mapped
+// through the OMAP_FROM stream.
+// @param pdb_file the PDB file to read.
+// @param dbi_stream the Dbi stream of @p pdb_file.
+// @param section_contribs receives the section contributions, in the order
+//     they appear in the Dbi stream.
+// @returns true on success, false otherwise.
+bool ReadSectionContribsFromPdbFile(
+    const PdbFile& pdb_file,
+    const DbiStream& dbi_stream,
+    std::vector<ImageSectionContrib>* section_contribs);
+
 // Ensures that the given stream in a PdbFile is writable.
 // @param index the index of the stream to make writable.
 // @param pdb_file the PdbFile containing the stream.
@@ -28,6 +28,7 @@
 #include "syzygy/common/dbghelp_util.h"
 #include "syzygy/core/unittest_util.h"
 #include "syzygy/pdb/pdb_byte_stream.h"
+#include "syzygy/pdb/pdb_dbi_stream.h"
 #include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/pdb_writer.h"
 #include "syzygy/pdb/unittest_util.h"
@@ -327,6 +328,42 @@ TEST_F(PdbUtilTest, GetDbiDbgHeaderOffsetOmappedTestDll) {
   EXPECT_NE(-1, dbi_dbg_header.omap_from_src);
 }
 
+TEST_F(PdbUtilTest, ReadFixupsFromPdbFile) {
+  PdbReader reader;
+  PdbFile pdb_file;
+  ASSERT_TRUE(reader.Read(
+      testing::GetSrcRelativePath(testing::kTestPdbFilePath),
+      &pdb_file));
+
+  // The test DLL is linked with /PROFILE, so it must have fixups.
+  std::vector<PdbFixup> fixups;
+  EXPECT_TRUE(ReadFixupsFromPdbFile(pdb_file, &fixups));
+  EXPECT_FALSE(fixups.empty());
+}
+
+TEST_F(PdbUtilTest, ReadSectionContribsFromPdbFile) {
+  const wchar_t* kPdbFilePaths[] = {
+      testing::kTestPdbFilePath, testing::kOmappedTestPdbFilePath };
+
+  for (size_t i = 0; i < arraysize(kPdbFilePaths); ++i) {
+    PdbReader reader;
+    PdbFile pdb_file;
+    ASSERT_TRUE(reader.Read(
+        testing::GetSrcRelativePath(kPdbFilePaths[i]),
+        &pdb_file));
+
+    DbiStream dbi_stream;
+    ASSERT_TRUE(dbi_stream.Read(pdb_file.GetStream(kDbiStream).get()));
+
+    std::vector<ImageSectionContrib> section_contribs;
+    EXPECT_TRUE(ReadSectionContribsFromPdbFile(pdb_file, dbi_stream,
+                                               &section_contribs));
+    EXPECT_EQ(dbi_stream.section_contribs().size(), section_contribs.size());
+    for (size_t j = 0; j < section_contribs.size(); ++j)
+      EXPECT_GT(dbi_stream.modules().size(), section_contribs[j].module);
+  }
+}
+
 TEST_F(PdbUtilTest, TestDllHasNoOmap) {
   // Test that test_dll.dll.pdb has no Omap information.
   base::FilePath test_pdb_file_path = testing::GetSrcRelativePath(
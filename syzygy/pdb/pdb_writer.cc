@@ -14,7 +14,10 @@
 
 #include "syzygy/pdb/pdb_writer.h"
 
+#include <algorithm>
+
 #include "base/logging.h"
+#include "syzygy/common/stage_profiler.h"
 #include "syzygy/pdb/pdb_constants.h"
 #include "syzygy/pdb/pdb_data.h"
 
@@ -209,6 +212,104 @@ bool WriteFreePageBitMap(const FreePageBitMap& free, FILE* file) {
   return true;
 }
 
+// @returns the number of pages needed to hold @p length bytes.
+uint32 GetPageCount(uint32 length) {
+  return (length + kPdbPageSize - 1) / kPdbPageSize;
+}
+
+// Reads data spread over pages of an MSF file.
+// @param file the file to read from.
+// @param pages the pages holding the data, in order.
+// @param length the length of the data, in bytes.
+// @param data receives the data.
+// @returns true on success, false otherwise.
+bool ReadPages(FILE* file, const uint32* pages, size_t length, void* data) {
+  DCHECK(file != NULL);
+  DCHECK(pages != NULL);
+  DCHECK(data != NULL);
+
+  uint8* dest = reinterpret_cast<uint8*>(data);
+  for (size_t i = 0; length > 0; ++i) {
+    size_t bytes_to_read = std::min<size_t>(length, kPdbPageSize);
+    if (::fseek(file, pages[i] * kPdbPageSize, SEEK_SET) != 0 ||
+        ::fread(dest, 1, bytes_to_read, file) != bytes_to_read) {
+      LOG(ERROR) << "Failed to read page " << pages[i] << ".";
+      return false;
+    }
+    dest += bytes_to_read;
+    length -= bytes_to_read;
+  }
+
+  return true;
+}
+
+// Reads the header and the directory of an MSF file written with the default
+// page size.
+// @param file the file to read from.
+// @param header receives the header.
+// @param directory receives the directory.
+// @returns true on success, false otherwise.
+bool ReadDirectory(FILE* file,
+                   PdbHeader* header,
+                   std::vector<uint32>* directory) {
+  DCHECK(file != NULL);
+  DCHECK(header != NULL);
+  DCHECK(directory != NULL);
+
+  if (::fseek(file, 0, SEEK_SET) != 0 ||
+      ::fread(header, sizeof(*header), 1, file) != 1) {
+    LOG(ERROR) << "Failed to read PDB header.";
+    return false;
+  }
+  if (::memcmp(header->magic_string, kPdbHeaderMagicString,
+               sizeof(kPdbHeaderMagicString)) != 0) {
+    LOG(ERROR) << "Invalid PDB magic string.";
+    return false;
+  }
+  if (header->page_size != kPdbPageSize) {
+    LOG(ERROR) << "Unsupported PDB page size: " << header->page_size << ".";
+    return false;
+  }
+
+  uint32 num_directory_pages = GetPageCount(header->directory_size);
+  if (num_directory_pages > arraysize(header->root_pages) * kPdbPageSize /
+          sizeof(uint32) ||
+      header->directory_size < sizeof(uint32) ||
+      header->directory_size % sizeof(uint32) != 0) {
+    LOG(ERROR) << "Invalid PDB directory size.";
+    return false;
+  }
+
+  std::vector<uint32> directory_pages(num_directory_pages);
+  if (!ReadPages(file, header->root_pages,
+                 num_directory_pages * sizeof(uint32),
+                 directory_pages.data())) {
+    return false;
+  }
+
+  directory->resize(header->directory_size / sizeof(uint32));
+  if (!ReadPages(file, directory_pages.data(), header->directory_size,
+                 directory->data())) {
+    return false;
+  }
+
+  // Make sure the directory is consistent with its size.
+  uint32 num_streams = directory->at(0);
+  if (num_streams >= directory->size()) {
+    LOG(ERROR) << "Invalid PDB directory.";
+    return false;
+  }
+  size_t expected_size = 1 + num_streams;
+  for (uint32 i = 0; i < num_streams; ++i)
+    expected_size += GetPageCount(directory->at(1 + i));
+  if (expected_size != directory->size()) {
+    LOG(ERROR) << "Invalid PDB directory.";
+    return false;
+  }
+
+  return true;
+}
+
 }  // namespace
 
 PdbWriter::PdbWriter() {
@@ -218,6 +319,8 @@ PdbWriter::~PdbWriter() {
 }
 
 bool PdbWriter::Write(const base::FilePath& pdb_path, const PdbFile& pdb_file) {
+  common::ScopedStageTimer timer("PdbWriter::Write");
+
   file_.reset(file_util::OpenFile(pdb_path, "wb"));
   if (!file_.get()) {
     LOG(ERROR) << "Failed to create '" << pdb_path.value() << "'.";
@@ -270,11 +373,140 @@ bool PdbWriter::Write(const base::FilePath& pdb_path, const PdbFile& pdb_file) {
   }
   DCHECK_LE(stream0_start, stream0_end);
 
+  // The pages corresponding to stream 0 are always marked as free, as well as
+  // page 3 which we allocated in the preamble.
+  std::vector<uint32> free_pages(1, 3);
+  free_pages.insert(free_pages.end(),
+                    directory.begin() + stream0_start,
+                    directory.begin() + stream0_end);
+
+  if (!WriteDirectory(directory, free_pages, &page_count))
+    return false;
+
+  // On success we want the file to be closed right away.
+  file_.reset();
+
+  return true;
+}
+
+bool PdbWriter::WriteIncremental(const base::FilePath& pdb_path,
+                                 const PdbFile& pdb_file,
+                                 const base::FilePath& source_path,
+                                 const PdbFile& source_pdb_file) {
+  common::ScopedStageTimer timer("PdbWriter::WriteIncremental");
+
+  if (pdb_path != source_path &&
+      !file_util::CopyFile(source_path, pdb_path)) {
+    LOG(ERROR) << "Failed to copy '" << source_path.value() << "' to '"
+               << pdb_path.value() << "'.";
+    return false;
+  }
+
+  file_.reset(file_util::OpenFile(pdb_path, "r+b"));
+  if (!file_.get()) {
+    LOG(ERROR) << "Failed to open '" << pdb_path.value() << "'.";
+    return false;
+  }
+
+  // Read the layout of the original streams.
+  PdbHeader header = {};
+  std::vector<uint32> source_directory;
+  if (!ReadDirectory(file_.get(), &header, &source_directory)) {
+    LOG(ERROR) << "Failed to read the directory of '" << pdb_path.value()
+               << "'.";
+    return false;
+  }
+  const uint32 kSourceStreamCount = source_directory[0];
+  const uint32* source_lengths = &source_directory[1];
+  std::vector<const uint32*> source_pages(kSourceStreamCount);
+  const uint32* pages = source_lengths + kSourceStreamCount;
+  for (uint32 i = 0; i < kSourceStreamCount; ++i) {
+    source_pages[i] = pages;
+    pages += GetPageCount(source_lengths[i]);
+  }
+
+  // Initialize the directory with stream count and lengths.
+  std::vector<uint32> directory;
+  directory.push_back(pdb_file.StreamCount());
+  for (size_t i = 0; i < pdb_file.StreamCount(); ++i) {
+    // Null streams have an implicit zero length.
+    PdbStream* stream = pdb_file.GetStream(i);
+    if (stream == NULL)
+      directory.push_back(0);
+    else
+      directory.push_back(stream->length());
+  }
+
+  // New pages are appended to the file.
+  uint32 page_count = header.num_pages;
+  if (::fseek(file_.get(), page_count * kPdbPageSize, SEEK_SET) != 0) {
+    LOG(ERROR) << "Failed to seek to the end of '" << pdb_path.value() << "'.";
+    return false;
+  }
+
+  // Reuse the pages of the unmodified streams, and append the others. Stream 0
+  // holds the previous directory, and is free as far as the free page map
+  // goes.
+  std::vector<bool> used_pages(page_count, false);
+  size_t num_reused_streams = 0;
+  for (size_t i = 0; i < pdb_file.StreamCount(); ++i) {
+    PdbStream* stream = pdb_file.GetStream(i);
+    if (stream == NULL || stream->length() == 0)
+      continue;
+
+    size_t stream_start = directory.size();
+    if (i < kSourceStreamCount && i < source_pdb_file.StreamCount() &&
+        stream == source_pdb_file.GetStream(i).get() &&
+        stream->length() == source_lengths[i]) {
+      directory.insert(directory.end(),
+                       source_pages[i],
+                       source_pages[i] + GetPageCount(stream->length()));
+      ++num_reused_streams;
+    } else if (!AppendStream(stream, &directory, &page_count)) {
+      LOG(ERROR) << "Failed to write stream " << i << ".";
+      return false;
+    }
+
+    if (i == 0)
+      continue;
+    for (size_t j = stream_start; j < directory.size(); ++j) {
+      if (directory[j] < used_pages.size())
+        used_pages[directory[j]] = true;
+    }
+  }
+
+  VLOG(1) << "Reused " << num_reused_streams << " of "
+          << pdb_file.StreamCount() << " streams.";
+
+  // The header page and the pages of the free page maps are never free. All
+  // the other original pages are free unless they are still in use, while
+  // the appended pages are in use.
+  std::vector<uint32> free_pages;
+  for (uint32 i = 1; i < used_pages.size(); ++i) {
+    uint32 page_in_interval = i % kPdbPageSize;
+    if (!used_pages[i] && page_in_interval != 1 && page_in_interval != 2)
+      free_pages.push_back(i);
+  }
+
+  if (!WriteDirectory(directory, free_pages, &page_count))
+    return false;
+
+  // On success we want the file to be closed right away.
+  file_.reset();
+
+  return true;
+}
+
+bool PdbWriter::WriteDirectory(const std::vector<uint32>& directory,
+                               const std::vector<uint32>& free_pages,
+                               uint32* page_count) {
+  DCHECK(page_count != NULL);
+
   // Write the directory, and keep track of the pages it is written to.
   std::vector<uint32> directory_pages;
   scoped_refptr<PdbStream> directory_stream(new ReadOnlyPdbStream(
       directory.data(), sizeof(directory[0]) * directory.size()));
-  if (!AppendStream(directory_stream.get(), &directory_pages, &page_count)) {
+  if (!AppendStream(directory_stream.get(), &directory_pages, page_count)) {
     LOG(ERROR) << "Failed to write directory.";
     return false;
   }
@@ -286,7 +518,7 @@ bool PdbWriter::Write(const base::FilePath& pdb_path, const PdbFile& pdb_file) {
       directory_pages.data(),
       sizeof(directory_pages[0]) * directory_pages.size()));
   if (!AppendStream(root_directory_stream.get(), &root_directory_pages,
-                    &page_count)) {
+                    page_count)) {
     LOG(ERROR) << "Failed to write root directory.";
     return false;
   }
@@ -294,19 +526,16 @@ bool PdbWriter::Write(const base::FilePath& pdb_path, const PdbFile& pdb_file) {
   // Write the header.
   if (!WriteHeader(root_directory_pages,
                    sizeof(directory[0]) * directory.size(),
-                   page_count)) {
+                   *page_count)) {
     LOG(ERROR) << "Failed to write PDB header.";
     return false;
   }
 
-  // Initialize the free page bit map. The pages corresponding to stream 0 are
-  // always marked as free, as well as page 3 which we allocated in the
-  // preamble.
+  // Initialize and write the free page bit map.
   FreePageBitMap free;
-  free.SetPageCount(page_count);
-  free.SetFree(3);
-  for (size_t i = stream0_start; i < stream0_end; ++i)
-    free.SetFree(directory[i]);
+  free.SetPageCount(*page_count);
+  for (size_t i = 0; i < free_pages.size(); ++i)
+    free.SetFree(free_pages[i]);
   free.Finalize();
 
   if (!WriteFreePageBitMap(free, file_.get())) {
@@ -314,9 +543,6 @@ bool PdbWriter::Write(const base::FilePath& pdb_path, const PdbFile& pdb_file) {
     return false;
   }
 
-  // On success we want the file to be closed right away.
-  file_.reset();
-
   return true;
 }
 
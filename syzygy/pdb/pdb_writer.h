@@ -38,6 +38,28 @@ class PdbWriter {
   // @returns true on success, false otherwise.
   bool Write(const base::FilePath& pdb_path, const PdbFile& pdb_file);
 
+  // Writes the given PdbFile to disk incrementally. The PDB file it was read
+  // from is copied to @p pdb_path, unless it's the same file, and only the
+  // streams that were modified since it was read are appended to it, along
+  // with a new directory. The unmodified streams keep their original pages,
+  // and the pages of the replaced streams are marked as free. This writes an
+  // amount of data proportional to the size of the modified streams rather
+  // than to the size of the whole file, at the cost of a larger file.
+  // @param pdb_path the path of the PDB file to write.
+  // @param pdb_file the PDB file to be written.
+  // @param source_path the path of the PDB file @p pdb_file was read from.
+  //     This may be @p pdb_path, in which case that file is updated in place
+  //     and is left in an invalid state should the write fail.
+  // @param source_pdb_file the streams of @p pdb_file as they were read from
+  //     @p source_path. A stream of @p pdb_file is considered unmodified if
+  //     it's the same object as the stream with the same index in
+  //     @p source_pdb_file.
+  // @returns true on success, false otherwise.
+  bool WriteIncremental(const base::FilePath& pdb_path,
+                        const PdbFile& pdb_file,
+                        const base::FilePath& source_path,
+                        const PdbFile& source_pdb_file);
+
  protected:
   // Append the contents of the stream onto the file handle at the offset. The
   // contents of the file are padded to reach the next page boundary in the
@@ -48,6 +70,15 @@ class PdbWriter {
                     std::vector<uint32>* pages_written,
                     uint32* page_count);
 
+  // Appends the directory and the root directory, then writes the header and
+  // the free page map. This is the last step of writing a PDB file.
+  // @param directory the directory to write.
+  // @param free_pages the indices of the pages that are free.
+  // @param page_count the number of pages in the file, which is updated.
+  bool WriteDirectory(const std::vector<uint32>& directory,
+                      const std::vector<uint32>& free_pages,
+                      uint32* page_count);
+
   // Writes the MSF header after the directory has been written.
   bool WriteHeader(const std::vector<uint32>& root_directory_pages,
                    size_t directory_size,
@@ -230,6 +230,64 @@ TEST(PdbWriterTest, WritePdbFile) {
       EnsurePdbContentsAreIdentical(pdb_file, pdb_file_read));
 }
 
+TEST(PdbWriterTest, WriteIncremental) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath source_path = temp_dir.path().AppendASCII("source.pdb");
+  base::FilePath pdb_path = temp_dir.path().AppendASCII("incremental.pdb");
+
+  PdbFile original_pdb_file;
+  for (uint32 i = 0; i < 4; ++i) {
+    original_pdb_file.AppendStream(
+        new TestPdbStream(1 << (12 + i), (i << 24)));
+  }
+  {
+    PdbWriter writer;
+    ASSERT_TRUE(writer.Write(source_path, original_pdb_file));
+  }
+
+  // Read the PDB file, and keep its original streams aside.
+  PdbFile source_pdb_file;
+  PdbReader reader;
+  ASSERT_TRUE(reader.Read(source_path, &source_pdb_file));
+  PdbFile pdb_file;
+  for (size_t i = 0; i < source_pdb_file.StreamCount(); ++i)
+    pdb_file.AppendStream(source_pdb_file.GetStream(i));
+
+  // Modify a stream, and add another one.
+  pdb_file.ReplaceStream(2, new TestPdbStream(3 * kPdbPageSize, 0xAA000000));
+  pdb_file.AppendStream(new TestPdbStream(kPdbPageSize / 2, 0xBB000000));
+
+  PdbWriter writer;
+  ASSERT_TRUE(writer.WriteIncremental(pdb_path, pdb_file, source_path,
+                                      source_pdb_file));
+
+  PdbFile pdb_file_read;
+  ASSERT_TRUE(reader.Read(pdb_path, &pdb_file_read));
+  ASSERT_NO_FATAL_FAILURE(
+      EnsurePdbContentsAreIdentical(pdb_file, pdb_file_read));
+
+  // Only the modified and new streams, and the directory, were appended.
+  int64 source_size = 0;
+  int64 pdb_size = 0;
+  ASSERT_TRUE(file_util::GetFileSize(source_path, &source_size));
+  ASSERT_TRUE(file_util::GetFileSize(pdb_path, &pdb_size));
+  EXPECT_EQ(source_size + 6 * kPdbPageSize, pdb_size);
+
+  // The file can also be updated in place.
+  PdbFile in_place_pdb_file;
+  for (size_t i = 0; i < source_pdb_file.StreamCount(); ++i)
+    in_place_pdb_file.AppendStream(source_pdb_file.GetStream(i));
+  in_place_pdb_file.ReplaceStream(0, NULL);
+  ASSERT_TRUE(writer.WriteIncremental(source_path, in_place_pdb_file,
+                                      source_path, source_pdb_file));
+
+  ASSERT_TRUE(reader.Read(source_path, &pdb_file_read));
+  in_place_pdb_file.ReplaceStream(0, new TestPdbStream(0, 0));
+  ASSERT_NO_FATAL_FAILURE(
+      EnsurePdbContentsAreIdentical(in_place_pdb_file, pdb_file_read));
+}
+
 TEST(PdbWriterTest, PdbStrCompatible) {
   base::FilePath test_dll_pdb =
       testing::GetSrcRelativePath(testing::kTestPdbFilePath);
@@ -45,6 +45,10 @@ const char kUsageFormatStr[] =
     "\n"
     "  If the image does not contain a CodeView record or it is malformed\n"
     "  exits with a return code of 3.\n"
+    "\n"
+    "  If the SYZYGY_FIND_CACHE environment variable names a file, the\n"
+    "  locations of found PDB files are remembered there and checked first\n"
+    "  on later searches.\n"
     "\n";
 
 }  // namespace
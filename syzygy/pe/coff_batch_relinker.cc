@@ -0,0 +1,131 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pe/coff_batch_relinker.h"
+
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
+#include "syzygy/core/closure_delegate.h"
+
+namespace pe {
+
+struct CoffBatchRelinker::ObjectFile {
+  ObjectFile(const base::FilePath& input_path,
+             const base::FilePath& output_path)
+      : input_path(input_path), output_path(output_path), succeeded(false) {
+  }
+
+  base::FilePath input_path;
+  base::FilePath output_path;
+
+  // Set to true once the object file has been relinked successfully.
+  bool succeeded;
+};
+
+CoffBatchRelinker::CoffBatchRelinker(
+    const CoffTransformPolicy* transform_policy)
+    : transform_policy_(transform_policy),
+      threads_(base::SysInfo::NumberOfProcessors()),
+      allow_overwrite_(false) {
+  DCHECK(transform_policy != NULL);
+}
+
+CoffBatchRelinker::~CoffBatchRelinker() {
+}
+
+void CoffBatchRelinker::AddObjectFile(const base::FilePath& input_path,
+                                      const base::FilePath& output_path) {
+  object_files_.push_back(new ObjectFile(input_path, output_path));
+}
+
+bool CoffBatchRelinker::RelinkAll() {
+  if (object_files_.empty())
+    return true;
+
+  size_t threads = std::min(threads_, object_files_.size());
+  LOG(INFO) << "Relinking " << object_files_.size() << " object file(s) on "
+            << threads << " thread(s).";
+
+  if (threads == 1) {
+    for (size_t i = 0; i < object_files_.size(); ++i)
+      RelinkObjectFile(object_files_[i]);
+  } else {
+    ScopedVector<core::ClosureDelegate> work;
+    for (size_t i = 0; i < object_files_.size(); ++i) {
+      work.push_back(new core::ClosureDelegate(
+          base::Bind(&CoffBatchRelinker::RelinkObjectFile,
+                     base::Unretained(this), object_files_[i])));
+    }
+
+    // The pool hands the object files out to the threads in the order they
+    // were added.
+    base::DelegateSimpleThreadPool pool("CoffBatchRelinker",
+                                        static_cast<int>(threads));
+    pool.Start();
+    for (size_t i = 0; i < work.size(); ++i)
+      pool.AddWork(work[i]);
+    pool.JoinAll();
+  }
+
+  size_t failures = 0;
+  for (size_t i = 0; i < object_files_.size(); ++i) {
+    if (!object_files_[i]->succeeded)
+      ++failures;
+  }
+  if (failures != 0) {
+    LOG(ERROR) << "Failed to relink " << failures << " of "
+               << object_files_.size() << " object file(s).";
+    return false;
+  }
+
+  return true;
+}
+
+void CoffBatchRelinker::RelinkObjectFile(ObjectFile* object_file) {
+  DCHECK(object_file != NULL);
+
+  // The transforms and orderers must outlive the relinker, so they are
+  // declared first.
+  RelinkerObjects objects;
+  CoffRelinker relinker(transform_policy_);
+  relinker.set_input_path(object_file->input_path);
+  relinker.set_output_path(object_file->output_path);
+  relinker.set_allow_overwrite(allow_overwrite_);
+
+  if (!relinker.Init()) {
+    LOG(ERROR) << "Failed to initialize relinker for \""
+               << object_file->input_path.value() << "\".";
+    return;
+  }
+
+  if (!configure_callback_.is_null() &&
+      !configure_callback_.Run(&relinker, &objects)) {
+    LOG(ERROR) << "Failed to configure relinker for \""
+               << object_file->input_path.value() << "\".";
+    return;
+  }
+
+  if (!relinker.Relink()) {
+    LOG(ERROR) << "Unable to relink \"" << object_file->input_path.value()
+               << "\".";
+    return;
+  }
+
+  object_file->succeeded = true;
+}
+
+}  // namespace pe
@@ -0,0 +1,134 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares CoffBatchRelinker, which relinks many COFF object files in a single
+// process. Instrumenting a static library otherwise means running the full
+// relinking workflow in a new process for each of its object files.
+//
+// It is intended to be used as follows:
+//
+//   CoffBatchRelinker batch_relinker(&policy);
+//   batch_relinker.AddObjectFile(input_path1, output_path1);
+//   batch_relinker.AddObjectFile(input_path2, output_path2);
+//   batch_relinker.set_configure_callback(...);  // Optional.
+//   batch_relinker.set_threads(...);  // Optional.
+//   batch_relinker.RelinkAll();  // Check the return value!
+
+#ifndef SYZYGY_PE_COFF_BATCH_RELINKER_H_
+#define SYZYGY_PE_COFF_BATCH_RELINKER_H_
+
+#include <vector>
+
+#include "base/callback.h"
+#include "base/files/file_path.h"
+#include "base/memory/scoped_vector.h"
+#include "syzygy/pe/coff_relinker.h"
+
+namespace pe {
+
+// Relinks a batch of COFF object files concurrently, using a pool of worker
+// threads. Each object file is relinked by a CoffRelinker of its own, and all
+// of them share the same transform policy and configuration.
+class CoffBatchRelinker {
+ public:
+  typedef block_graph::BlockGraphTransformInterface Transform;
+  typedef block_graph::BlockGraphOrdererInterface Orderer;
+
+  // The transforms and orderers created for one object file. They are owned
+  // by the batch relinker and outlive the relinker they are appended to.
+  struct RelinkerObjects {
+    ScopedVector<Transform> transforms;
+    ScopedVector<Orderer> orderers;
+  };
+
+  // The callback used to configure the relinker of each object file, once it
+  // has been initialized. It typically creates transforms and orderers in
+  // @p objects, and appends them to @p relinker. As transforms usually keep
+  // state about the block graph they were applied to, each object file needs
+  // its own instances.
+  // @note This is called concurrently on the worker threads, and must be
+  //     thread-safe.
+  typedef base::Callback<bool(CoffRelinker* relinker,
+                              RelinkerObjects* objects)> ConfigureCallback;
+
+  // Constructor.
+  // @param transform_policy The policy that dictates how to apply transforms.
+  //     This is shared by all of the relinkers, so it must be thread-safe.
+  explicit CoffBatchRelinker(const CoffTransformPolicy* transform_policy);
+
+  // Destructor.
+  ~CoffBatchRelinker();
+
+  // Adds an object file to the batch.
+  // @param input_path The path of the object file to relink.
+  // @param output_path The path of the relinked object file.
+  void AddObjectFile(const base::FilePath& input_path,
+                     const base::FilePath& output_path);
+
+  // @name Accessors and mutators.
+  // @{
+  size_t object_file_count() const { return object_files_.size(); }
+  size_t threads() const { return threads_; }
+  bool allow_overwrite() const { return allow_overwrite_; }
+
+  // Sets the callback used to configure the relinker of each object file. By
+  // default the object files are relinked without any transform.
+  void set_configure_callback(const ConfigureCallback& configure_callback) {
+    configure_callback_ = configure_callback;
+  }
+
+  // Sets the number of worker threads. Defaults to the number of processors.
+  void set_threads(size_t threads) {
+    DCHECK_LT(0u, threads);
+    threads_ = threads;
+  }
+
+  // Sets whether or not the output files may be overwritten. Defaults to
+  // false.
+  void set_allow_overwrite(bool allow_overwrite) {
+    allow_overwrite_ = allow_overwrite;
+  }
+  // @}
+
+  // Relinks all of the object files that have been added. The object files
+  // are all processed even if some of them fail, so that every failure gets
+  // logged.
+  // @returns true if every object file was relinked successfully, false
+  //     otherwise.
+  bool RelinkAll();
+
+ private:
+  // Forward declaration.
+  struct ObjectFile;
+
+  // Relinks a single object file, recording the outcome in it.
+  // @param object_file The object file to relink.
+  void RelinkObjectFile(ObjectFile* object_file);
+
+  // The policy shared by all relinkers.
+  const CoffTransformPolicy* transform_policy_;
+
+  // The object files to relink, in the order they were added.
+  ScopedVector<ObjectFile> object_files_;
+
+  ConfigureCallback configure_callback_;
+  size_t threads_;
+  bool allow_overwrite_;
+
+  DISALLOW_COPY_AND_ASSIGN(CoffBatchRelinker);
+};
+
+}  // namespace pe
+
+#endif  // SYZYGY_PE_COFF_BATCH_RELINKER_H_
@@ -0,0 +1,144 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pe/coff_batch_relinker.h"
+
+#include "base/atomicops.h"
+#include "base/bind.h"
+#include "base/file_util.h"
+#include "base/stringprintf.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/pe/unittest_util.h"
+
+namespace pe {
+
+namespace {
+
+using block_graph::BlockGraph;
+using block_graph::TransformPolicyInterface;
+
+// A transform that counts the block graphs it is applied to.
+class CountingTransform : public block_graph::BlockGraphTransformInterface {
+ public:
+  explicit CountingTransform(base::subtle::Atomic32* count) : count_(count) {
+  }
+
+  virtual const char* name() const OVERRIDE { return "CountingTransform"; }
+
+  virtual bool TransformBlockGraph(const TransformPolicyInterface* policy,
+                                   BlockGraph* block_graph,
+                                   BlockGraph::Block* headers_block) OVERRIDE {
+    base::subtle::NoBarrier_AtomicIncrement(count_, 1);
+    return true;
+  }
+
+ private:
+  base::subtle::Atomic32* count_;
+};
+
+bool AddCountingTransform(base::subtle::Atomic32* count,
+                          CoffRelinker* relinker,
+                          CoffBatchRelinker::RelinkerObjects* objects) {
+  objects->transforms.push_back(new CountingTransform(count));
+  return relinker->AppendTransform(objects->transforms.back());
+}
+
+bool FailToConfigure(CoffRelinker* relinker,
+                     CoffBatchRelinker::RelinkerObjects* objects) {
+  return false;
+}
+
+class CoffBatchRelinkerTest : public testing::PELibUnitTest {
+ public:
+  virtual void SetUp() OVERRIDE {
+    testing::PELibUnitTest::SetUp();
+
+    test_dll_obj_path_ =
+        testing::GetExeTestDataRelativePath(testing::kTestDllCoffObjName);
+    ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir_path_));
+  }
+
+  // Adds @p count copies of the test object file to @p batch_relinker.
+  void AddObjectFiles(size_t count, CoffBatchRelinker* batch_relinker) {
+    for (size_t i = 0; i < count; ++i) {
+      base::FilePath output_path = temp_dir_path_.Append(
+          base::StringPrintf(L"test_dll_%d.obj",
+                             static_cast<int>(output_paths_.size())));
+      batch_relinker->AddObjectFile(test_dll_obj_path_, output_path);
+      output_paths_.push_back(output_path);
+    }
+  }
+
+  CoffTransformPolicy policy_;
+  base::FilePath test_dll_obj_path_;
+  base::FilePath temp_dir_path_;
+  std::vector<base::FilePath> output_paths_;
+};
+
+}  // namespace
+
+TEST_F(CoffBatchRelinkerTest, EmptyBatchSucceeds) {
+  CoffBatchRelinker batch_relinker(&policy_);
+  EXPECT_EQ(0u, batch_relinker.object_file_count());
+  EXPECT_TRUE(batch_relinker.RelinkAll());
+}
+
+TEST_F(CoffBatchRelinkerTest, RelinksAllObjectFiles) {
+  base::subtle::Atomic32 count = 0;
+
+  CoffBatchRelinker batch_relinker(&policy_);
+  batch_relinker.set_threads(3);
+  batch_relinker.set_configure_callback(
+      base::Bind(&AddCountingTransform, &count));
+  ASSERT_NO_FATAL_FAILURE(AddObjectFiles(8, &batch_relinker));
+  EXPECT_EQ(8u, batch_relinker.object_file_count());
+
+  EXPECT_TRUE(batch_relinker.RelinkAll());
+
+  // Each object file should have had a transform of its own applied to it.
+  EXPECT_EQ(8, base::subtle::NoBarrier_Load(&count));
+  for (size_t i = 0; i < output_paths_.size(); ++i)
+    EXPECT_TRUE(file_util::PathExists(output_paths_[i]));
+}
+
+TEST_F(CoffBatchRelinkerTest, FailuresDoNotStopTheBatch) {
+  DisableLogging();
+
+  CoffBatchRelinker batch_relinker(&policy_);
+  batch_relinker.set_threads(2);
+  ASSERT_NO_FATAL_FAILURE(AddObjectFiles(2, &batch_relinker));
+  batch_relinker.AddObjectFile(temp_dir_path_.Append(L"nonexistent.obj"),
+                               temp_dir_path_.Append(L"nonexistent_out.obj"));
+  ASSERT_NO_FATAL_FAILURE(AddObjectFiles(2, &batch_relinker));
+
+  EXPECT_FALSE(batch_relinker.RelinkAll());
+
+  // The valid object files should all have been relinked.
+  for (size_t i = 0; i < output_paths_.size(); ++i)
+    EXPECT_TRUE(file_util::PathExists(output_paths_[i]));
+}
+
+TEST_F(CoffBatchRelinkerTest, FailsWhenConfigureFails) {
+  DisableLogging();
+
+  CoffBatchRelinker batch_relinker(&policy_);
+  batch_relinker.set_configure_callback(base::Bind(&FailToConfigure));
+  ASSERT_NO_FATAL_FAILURE(AddObjectFiles(1, &batch_relinker));
+
+  EXPECT_FALSE(batch_relinker.RelinkAll());
+  EXPECT_FALSE(file_util::PathExists(output_paths_[0]));
+}
+
+}  // namespace pe
@@ -24,6 +24,7 @@
 #include "base/files/file_path.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/pe/decomposer.h"
+#include "syzygy/pe/decomposition_cache.h"
 #include "syzygy/pe/pe_file.h"
 #include "syzygy/pe/serialization.h"
 
@@ -49,6 +50,11 @@ const char kUsageFormatStr[] =
     "  --benchmark-load\n"
     "    Causes the output to be deserialized after serialization,\n"
     "    for benchmarking.\n"
+    "  --cache-dir=<directory>\n"
+    "    The decomposition cache directory. If the decomposition of the image\n"
+    "    is found there it will be loaded rather than recomputed, otherwise\n"
+    "    it will be added to the cache. Defaults to the value of the\n"
+    "    SYZYGY_DECOMPOSITION_CACHE_DIR environment variable.\n"
     "  --graph-only\n"
     "    Causes the serialized output to only contain the block-graph, with\n"
     "    all data inlined. The PE file (and pe_lib) will not be needed to\n"
@@ -94,6 +100,11 @@ bool DecomposeApp::ParseCommandLine(const CommandLine* cmd_line) {
     LOG(INFO) << "Inferring output path from image path.";
   }
 
+  if (cmd_line->HasSwitch("cache-dir"))
+    cache_dir_ = cmd_line->GetSwitchValuePath("cache-dir");
+  else
+    DecompositionCache::GetCacheDirFromEnvironment(&cache_dir_);
+
   benchmark_load_ = cmd_line->HasSwitch("benchmark-load");
   graph_only_ = cmd_line->HasSwitch("graph-only");
   strip_strings_ = cmd_line->HasSwitch("strip-strings");
@@ -116,6 +127,7 @@ int DecomposeApp::Run() {
   BlockGraph block_graph;
   pe::ImageLayout image_layout(&block_graph);
   pe::Decomposer decomposer(pe_file);
+  decomposer.set_cache_dir(cache_dir_);
   {
     ScopedTimeLogger scoped_time_logger("Decomposing image");
     if (!decomposer.Decompose(&image_layout))
@@ -143,7 +155,8 @@ bool DecomposeApp::SaveDecomposedImage(
     const pe::PEFile& pe_file, const pe::ImageLayout& image_layout,
     const base::FilePath& output_path) const {
   file_util::ScopedFILE out_file(file_util::OpenFile(output_path, "wb"));
-  core::FileOutStream out_stream(out_file.get());
+  core::FileOutStream file_stream(out_file.get());
+  core::BufferedOutStream out_stream(&file_stream);
   core::NativeBinaryOutArchive out_archive(&out_stream);
 
   BlockGraphSerializer::Attributes attributes = 0;
@@ -177,7 +190,8 @@ bool DecomposeApp::LoadDecomposedImage(const base::FilePath& file_path) const {
   BlockGraph block_graph;
 
   file_util::ScopedFILE in_file(file_util::OpenFile(file_path, "rb"));
-  core::FileInStream in_stream(in_file.get());
+  core::FileInStream file_stream(in_file.get());
+  core::BufferedInStream in_stream(&file_stream);
   core::NativeBinaryInArchive in_archive(&in_stream);
 
   if (graph_only_) {
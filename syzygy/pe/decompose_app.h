@@ -75,6 +75,7 @@ class DecomposeApp : public common::AppImplBase {
   // @{
   base::FilePath image_path_;
   base::FilePath output_path_;
+  base::FilePath cache_dir_;
   bool benchmark_load_;
   bool graph_only_;
   bool strip_strings_;
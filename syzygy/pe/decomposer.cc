@@ -16,6 +16,7 @@
 
 #include <cvconst.h>
 #include <algorithm>
+#include <map>
 
 #include "base/bind.h"
 #include "base/logging.h"
@@ -25,17 +26,24 @@
 #include "base/utf_string_conversions.h"
 #include "base/files/file_path.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/memory/scoped_vector.h"
+#include "base/threading/simple_thread.h"
 #include "base/win/scoped_bstr.h"
 #include "base/win/scoped_comptr.h"
 #include "sawbuck/common/com_utils.h"
 #include "sawbuck/sym_util/types.h"
 #include "syzygy/block_graph/block_util.h"
 #include "syzygy/block_graph/typed_block.h"
+#include "syzygy/common/stage_profiler.h"
+#include "syzygy/core/closure_delegate.h"
 #include "syzygy/core/disassembler_util.h"
 #include "syzygy/core/zstream.h"
 #include "syzygy/pdb/omap.h"
 #include "syzygy/pdb/pdb_byte_stream.h"
+#include "syzygy/pdb/pdb_dbi_stream.h"
+#include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/pdb_util.h"
+#include "syzygy/pe/decomposition_cache.h"
 #include "syzygy/pe/dia_util.h"
 #include "syzygy/pe/find.h"
 #include "syzygy/pe/metadata.h"
@@ -62,6 +70,11 @@ typedef Disassembler::CallbackDirective CallbackDirective;
 
 const size_t kPointerSize = sizeof(AbsoluteAddress);
 
+// When disassembling in parallel, code is split into this many shards per
+// worker thread. Having more shards than threads evens out the load when some
+// address ranges are much more expensive to disassemble than others.
+const size_t kDisassemblyShardsPerThread = 8;
+
 // Converts from PdbFixup::Type to BlockGraph::ReferenceType.
 BlockGraph::ReferenceType PdbFixupTypeToReferenceType(
     pdb::PdbFixup::Type type) {
@@ -511,6 +524,65 @@ bool IsBuiltBySupportedCompiler(IDiaSymbol* compiland) {
   return false;
 }
 
+// Maps compiland names to whether or not they were built by a supported
+// compiler.
+typedef std::map<std::string, bool> CompilandSupportMap;
+
+// Determines which compilands were built by a supported compiler, looking at
+// each compiland only once. Compilands that share a name are only considered
+// supported if all of them are.
+bool GetCompilandSupport(IDiaSession* session,
+                         CompilandSupportMap* compiland_support) {
+  DCHECK(session != NULL);
+  DCHECK(compiland_support != NULL);
+
+  ScopedComPtr<IDiaSymbol> global;
+  HRESULT hr = session->get_globalScope(global.Receive());
+  if (hr != S_OK) {
+    LOG(ERROR) << "Failed to get the DIA global scope: "
+               << com::LogHr(hr) << ".";
+    return false;
+  }
+
+  ScopedComPtr<IDiaEnumSymbols> compilands;
+  hr = global->findChildren(SymTagCompiland, NULL, 0, compilands.Receive());
+  if (hr != S_OK) {
+    LOG(ERROR) << "Failed to enumerate compilands: " << com::LogHr(hr) << ".";
+    return false;
+  }
+
+  while (true) {
+    ScopedComPtr<IDiaSymbol> compiland;
+    ULONG fetched = 0;
+    hr = compilands->Next(1, compiland.Receive(), &fetched);
+    if (FAILED(hr)) {
+      LOG(ERROR) << "Failed to get compiland: " << com::LogHr(hr) << ".";
+      return false;
+    }
+    if (hr != S_OK || fetched == 0)
+      break;
+
+    ScopedBstr bstr_name;
+    if ((hr = compiland->get_name(bstr_name.Receive())) != S_OK) {
+      LOG(ERROR) << "Failed to get compiland name: " << com::LogHr(hr) << ".";
+      return false;
+    }
+    std::string name;
+    if (!WideToUTF8(bstr_name, bstr_name.Length(), &name)) {
+      LOG(ERROR) << "Failed to convert compiland name to UTF8.";
+      return false;
+    }
+
+    bool supported = IsBuiltBySupportedCompiler(compiland.get());
+    std::pair<CompilandSupportMap::iterator, bool> result =
+        compiland_support->insert(std::make_pair(name, supported));
+    if (!result.second)
+      result.first->second = result.first->second && supported;
+  }
+
+  return true;
+}
+
 // Logs an error if @p error is true, a verbose logging message otherwise.
 #define LOG_ERROR_OR_VLOG1(error) LAZY_STREAM( \
     ::logging::LogMessage(__FILE__, \
@@ -585,8 +657,11 @@ bool HasDataLabelInRange(const BlockGraph::Block* block,
   return false;
 }
 
+// @p block_refs must contain the references originating in @p block, while
+// @p image_refs must contain those originating in the rest of the image.
 void ReportPotentialNonReturningFunction(
-    const Decomposer::IntermediateReferenceMap& refs,
+    const Decomposer::IntermediateReferenceMap& block_refs,
+    const Decomposer::IntermediateReferenceMap& image_refs,
     const BlockGraph::AddressSpace& image,
     const BlockGraph::Block* block,
     BlockGraph::Offset call_ref_offset,
@@ -595,8 +670,8 @@ void ReportPotentialNonReturningFunction(
 
   // Try and track down the block being pointed at by the call. If this is a
   // computed address there will be no reference.
-  RefIter ref_it = refs.find(block->addr() + call_ref_offset);
-  if (ref_it == refs.end()) {
+  RefIter ref_it = block_refs.find(block->addr() + call_ref_offset);
+  if (ref_it == block_refs.end()) {
     LOG(WARNING) << "Suspected non-returning function call from offset "
                  << call_ref_offset << " (followed by " << reason
                  << ") of block \"" << block->name()
@@ -624,8 +699,8 @@ void ReportPotentialNonReturningFunction(
   DCHECK_EQ(BlockGraph::DATA_BLOCK, target->type());
 
   // Track down the import thunk.
-  RefIter thunk_ref_it = refs.find(ref_it->second.base);
-  DCHECK(thunk_ref_it != refs.end());
+  RefIter thunk_ref_it = image_refs.find(ref_it->second.base);
+  DCHECK(thunk_ref_it != image_refs.end());
   BlockGraph::Block* thunk = image.GetBlockByAddress(thunk_ref_it->second.base);
 
   // If this was marked as non-returning, then its not suspicious.
@@ -639,32 +714,39 @@ void ReportPotentialNonReturningFunction(
                << thunk->name() << "\".";
 }
 
+// @p block_attributes are the attributes @p block will have once its
+// disassembly has been merged.
 void LookForNonReturningFunctions(
-    const Decomposer::IntermediateReferenceMap& refs,
+    const Decomposer::IntermediateReferenceMap& block_refs,
+    const Decomposer::IntermediateReferenceMap& image_refs,
     const BlockGraph::AddressSpace& image,
     const BlockGraph::Block* block,
+    BlockGraph::BlockAttributes block_attributes,
     const Disassembler& disasm) {
   bool saw_call = false;
   bool saw_call_then_nop = false;
   BlockGraph::Offset call_ref_offset = 0;
 
   AbsoluteAddress end_of_last_inst;
-  Disassembler::VisitedSpace::const_iterator inst_it =
-      disasm.visited().begin();
-  for (; inst_it != disasm.visited().end(); ++inst_it) {
+  for (size_t inst_offset = 0; inst_offset < disasm.code_size();
+       ++inst_offset) {
+    AbsoluteAddress inst_addr(disasm.code_addr() + inst_offset);
+    if (!disasm.IsInstructionStart(inst_addr))
+      continue;
+
     // Not contiguous with the last instruction? Then we're spanning a gap. If
     // it's an instruction then we didn't parse it; thus, we already know that
     // if the last instruction is a call it's to a non-returning function. So,
     // we only need to check for data.
-    if (inst_it->first.start() != end_of_last_inst) {
+    if (inst_addr != end_of_last_inst) {
       if (saw_call || saw_call_then_nop) {
         BlockGraph::Offset offset = end_of_last_inst - disasm.code_addr();
-        BlockGraph::Size size = inst_it->first.start() - end_of_last_inst;
+        BlockGraph::Size size = inst_addr - end_of_last_inst;
         if (HasDataLabelInRange(block, offset, size))
           // We do not expect this to ever occur in cl.exe generated code.
           // However, it is entirely possible in hand-written assembly.
           ReportPotentialNonReturningFunction(
-              refs, image, block, call_ref_offset,
+              block_refs, image_refs, image, block, call_ref_offset,
               saw_call ? "data" : "nop(s) and data");
       }
 
@@ -673,9 +755,10 @@ void LookForNonReturningFunctions(
     }
 
     _DInst inst = { 0 };
-    BlockGraph::Offset offset = inst_it->first.start() - disasm.code_addr();
+    BlockGraph::Offset offset = inst_offset;
     const uint8* code = disasm.code() + offset;
-    CHECK(core::DecodeOneInstruction(code, inst_it->first.size(), &inst));
+    CHECK(core::DecodeOneInstruction(code, disasm.code_size() - inst_offset,
+                                     &inst));
 
     // Previous instruction was a call?
     if (saw_call) {
@@ -683,7 +766,7 @@ void LookForNonReturningFunctions(
         saw_call_then_nop = true;
       } else if (core::IsDebugInterrupt(inst)) {
         ReportPotentialNonReturningFunction(
-            refs, image, block, call_ref_offset, "int3");
+            block_refs, image_refs, image, block, call_ref_offset, "int3");
       }
       saw_call = false;
     } else if (saw_call_then_nop) {
@@ -696,22 +779,24 @@ void LookForNonReturningFunctions(
       // the offset of its operand (the call target).
       if (core::IsCall(inst)) {
         saw_call = true;
-        call_ref_offset = offset + inst_it->first.size() -
+        call_ref_offset = offset + inst.size -
             BlockGraph::Reference::kMaximumSize;
       }
     }
 
-    // Remember the end of the last instruction we processed.
-    end_of_last_inst = inst_it->first.end();
+    // Remember the end of the last instruction we processed, and skip over
+    // the rest of its bytes.
+    end_of_last_inst = inst_addr + inst.size;
+    inst_offset += inst.size - 1;
   }
 
   // If the last instruction was a call and we've marked that we've disassembled
   // past the end, then this is also a suspected non-returning function.
   if ((saw_call || saw_call_then_nop) &&
-      (block->attributes() & BlockGraph::DISASSEMBLED_PAST_END) != 0) {
+      (block_attributes & BlockGraph::DISASSEMBLED_PAST_END) != 0) {
     const char* reason = saw_call ? "end of block" : "nop(s) and end of block";
     ReportPotentialNonReturningFunction(
-        refs, image, block, call_ref_offset, reason);
+        block_refs, image_refs, image, block, call_ref_offset, reason);
   }
 }
 
@@ -763,13 +848,25 @@ bool AlignCodeBlocksWithJumpTables(ImageLayout* image_layout) {
   return true;
 }
 
+// Orders disassembly states by the position of their blocks in the image.
+// This keeps each disassembly shard to a contiguous address range within a
+// single section.
+bool DisassemblyStateAddressLess(const Decomposer::DisassemblyState* s1,
+                                 const Decomposer::DisassemblyState* s2) {
+  if (s1->block->section() != s2->block->section())
+    return s1->block->section() < s2->block->section();
+  return s1->block->addr() < s2->block->addr();
+}
+
 }  // namespace
 
 Decomposer::Decomposer(const PEFile& image_file)
     : image_(NULL),
       image_file_(image_file),
-      current_block_(NULL),
-      be_strict_with_current_block_(true) {
+      disassembly_threads_(1),
+      loaded_from_cache_(false) {
+  DecompositionCache::GetCacheDirFromEnvironment(&cache_dir_);
+
   // Register static initializer patterns that we know are always present.
   // CRT C/C++/etc initializers.
   CHECK(RegisterStaticInitializerPatterns("(__x.*)_a", "(__x.*)_z"));
@@ -792,6 +889,8 @@ Decomposer::Decomposer(const PEFile& image_file)
 }
 
 bool Decomposer::Decompose(ImageLayout* image_layout) {
+  common::ScopedStageTimer timer("Decomposer::Decompose");
+
   // We start by finding the PDB path.
   if (!FindAndValidatePdbPath())
     return false;
@@ -810,6 +909,32 @@ bool Decomposer::Decompose(ImageLayout* image_layout) {
       return false;
   }
 
+  loaded_from_cache_ = false;
+  if (cache_dir_.empty())
+    return DecomposeImpl(image_layout);
+
+  // Consult the decomposition cache before doing any real work.
+  DecompositionCache cache(cache_dir_);
+  if (!cache.Load(image_file_, pdb_path_, image_layout, &loaded_from_cache_))
+    return false;
+  if (loaded_from_cache_)
+    return true;
+
+  if (!DecomposeImpl(image_layout))
+    return false;
+
+  // A failure to populate the cache doesn't invalidate the decomposition.
+  if (!cache.Save(image_file_, pdb_path_, *image_layout)) {
+    LOG(WARNING) << "Unable to save decomposition to cache directory \""
+                 << cache_dir_.value() << "\".";
+  }
+
+  return true;
+}
+
+bool Decomposer::DecomposeImpl(ImageLayout* image_layout) {
+  DCHECK(image_layout != NULL);
+
   // Move on to instantiating and initializing our Debug Interface Access
   // session.
   ScopedComPtr<IDiaDataSource> dia_source;
@@ -1641,76 +1766,70 @@ bool Decomposer::ValidateRelocs(const PEFile::RelocMap& reloc_map) {
 }
 
 bool Decomposer::CreateBlocksFromSectionContribs(IDiaSession* session) {
-  ScopedComPtr<IDiaEnumSectionContribs> section_contribs;
-  SearchResult search_result = FindDiaTable(session,
-                                            section_contribs.Receive());
-  if (search_result != kSearchSucceeded) {
-    if (search_result == kSearchFailed)
-      LOG(ERROR) << "No section contribution table found.";
+  // The section contributions are read straight from the Dbi stream as a
+  // flat array, which is much faster than enumerating them via DIA.
+  pdb::PdbFile pdb_file;
+  pdb::PdbReader pdb_reader;
+  if (!pdb_reader.Read(pdb_path_, &pdb_file)) {
+    LOG(ERROR) << "Failed to load PDB: " << pdb_path_.value();
     return false;
   }
 
-  size_t rsrc_id = image_file_.GetSectionIndex(kResourceSectionName);
+  pdb::DbiStream dbi_stream;
+  scoped_refptr<pdb::PdbStream> dbi = pdb_file.GetStream(pdb::kDbiStream);
+  if (dbi.get() == NULL || !dbi_stream.Read(dbi.get())) {
+    LOG(ERROR) << "Failed to read the Dbi stream.";
+    return false;
+  }
 
-  LONG count = 0;
-  if (section_contribs->get_Count(&count) != S_OK) {
-    LOG(ERROR) << "Failed to get section contributions enumeration length.";
+  std::vector<pdb::ImageSectionContrib> section_contribs;
+  if (!pdb::ReadSectionContribsFromPdbFile(pdb_file, dbi_stream,
+                                           &section_contribs)) {
     return false;
   }
 
-  for (LONG visited = 0; visited < count; ++visited) {
-    ScopedComPtr<IDiaSectionContrib> section_contrib;
-    ULONG fetched = 0;
-    HRESULT hr = section_contribs->Next(1, section_contrib.Receive(), &fetched);
-    if (hr != S_OK) {
-      LOG(ERROR) << "Failed to get DIA section contribution: "
-                 << com::LogHr(hr) << ".";
-      return false;
-    }
-    if (fetched == 0)
-      break;
+  // DIA is now only used to look at the compiler of each compiland.
+  CompilandSupportMap compiland_support;
+  if (!GetCompilandSupport(session, &compiland_support))
+    return false;
 
-    hr = E_FAIL;
-    DWORD rva = 0;
-    DWORD length = 0;
-    DWORD section_id = 0;
-    BOOL code = FALSE;
-    ScopedComPtr<IDiaSymbol> compiland;
-    ScopedBstr bstr_name;
-    if ((hr = section_contrib->get_relativeVirtualAddress(&rva)) != S_OK ||
-        (hr = section_contrib->get_length(&length)) != S_OK ||
-        (hr = section_contrib->get_addressSection(&section_id)) != S_OK ||
-        (hr = section_contrib->get_code(&code)) != S_OK ||
-        (hr = section_contrib->get_compiland(compiland.Receive())) != S_OK ||
-        (hr = compiland->get_name(bstr_name.Receive())) != S_OK) {
-      LOG(ERROR) << "Failed to get section contribution properties: "
-                 << com::LogHr(hr) << ".";
+  // We don't parse the resource section, as it is parsed by the PEFileParser.
+  RelativeAddress rsrc_start;
+  RelativeAddress rsrc_end;
+  size_t rsrc_id = image_file_.GetSectionIndex(kResourceSectionName);
+  if (rsrc_id != kInvalidSection) {
+    const IMAGE_SECTION_HEADER* rsrc = image_file_.section_header(rsrc_id);
+    rsrc_start = RelativeAddress(rsrc->VirtualAddress);
+    rsrc_end = rsrc_start + rsrc->Misc.VirtualSize;
+  }
+
+  const pdb::DbiStream::DbiModuleVector& modules = dbi_stream.modules();
+  for (size_t i = 0; i < section_contribs.size(); ++i) {
+    const pdb::ImageSectionContrib& section_contrib = section_contribs[i];
+    RelativeAddress rva = section_contrib.rva;
+    size_t length = section_contrib.length;
+    if (rva >= rsrc_start && rva < rsrc_end)
+      continue;
+
+    if (section_contrib.module >= modules.size()) {
+      LOG(ERROR) << "Section contribution refers to invalid module "
+                 << section_contrib.module << ".";
       return false;
     }
+    const std::string& name = modules[section_contrib.module].module_name();
 
     // Determine if this function was built by a supported compiler.
+    CompilandSupportMap::const_iterator support_it =
+        compiland_support.find(name);
     bool is_built_by_supported_compiler =
-        IsBuiltBySupportedCompiler(compiland.get());
-
-    // DIA numbers sections from 1 to n, while we do 0 to n - 1.
-    DCHECK_LT(0u, section_id);
-    --section_id;
-
-    // We don't parse the resource section, as it is parsed by the PEFileParser.
-    if (section_id == rsrc_id)
-      continue;
-
-    std::string name;
-    if (!WideToUTF8(bstr_name, bstr_name.Length(), &name)) {
-      LOG(ERROR) << "Failed to convert compiland name to UTF8.";
-      return false;
-    }
+        support_it != compiland_support.end() && support_it->second;
+    bool code = (section_contrib.characteristics & IMAGE_SCN_CNT_CODE) != 0;
 
     // Create the block.
     BlockGraph::BlockType block_type =
         code ? BlockGraph::CODE_BLOCK : BlockGraph::DATA_BLOCK;
     BlockGraph::Block* block = FindOrCreateBlock(block_type,
-                                                 RelativeAddress(rva),
+                                                 rva,
                                                  length,
                                                  name.c_str(),
                                                  kExpectNoBlock);
@@ -2038,6 +2157,9 @@ bool Decomposer::GuessDataBlockAlignments() {
 }
 
 bool Decomposer::CreateCodeReferences() {
+  // Gather the code blocks in block ID order. This is the order in which their
+  // disassembly is applied to the decomposition.
+  ScopedVector<DisassemblyState> states;
   BlockGraph::BlockMap::iterator it(image_->graph()->blocks_mutable().begin());
   BlockGraph::BlockMap::iterator end(image_->graph()->blocks_mutable().end());
   for (; it != end; ++it) {
@@ -2045,16 +2167,172 @@ bool Decomposer::CreateCodeReferences() {
     if (block->type() != BlockGraph::CODE_BLOCK)
       continue;
 
-    if (!CreateCodeReferencesForBlock(block))
+    states.push_back(new DisassemblyState(block));
+  }
+
+  if (disassembly_threads_ > 1 && states.size() > 1)
+    return CreateCodeReferencesInParallel(states.get());
+
+  for (size_t i = 0; i < states.size(); ++i) {
+    DisassemblyState* state = states[i];
+    state->references = &references_;
+    state->result = CreateCodeReferencesForBlock(state);
+    if (!MergeDisassemblyState(state))
       return false;
   }
 
   return true;
 }
 
-bool Decomposer::CreateCodeReferencesForBlock(BlockGraph::Block* block) {
-  DCHECK(current_block_ == NULL);
-  current_block_ = block;
+bool Decomposer::CreateCodeReferencesInParallel(
+    const std::vector<DisassemblyState*>& states) {
+  DCHECK_LT(1u, disassembly_threads_);
+
+  // Prepare each state for a speculative walk. Each walk works on a private
+  // copy of the references originating in its block, and records enough of
+  // the block's state that the walk can be rolled back.
+  size_t code_size = 0;
+  for (size_t i = 0; i < states.size(); ++i) {
+    DisassemblyState* state = states[i];
+    BlockGraph::Block* block = state->block;
+    RelativeAddress block_end = block->addr() + block->size();
+
+    state->speculative = true;
+    state->references = &state->local_references;
+    state->local_references.insert(references_.lower_bound(block->addr()),
+                                   references_.lower_bound(block_end));
+    FixupMap::const_iterator fixup_it = fixup_map_.lower_bound(block->addr());
+    FixupMap::const_iterator fixup_end = fixup_map_.lower_bound(block_end);
+    for (; fixup_it != fixup_end; ++fixup_it)
+      state->saved_fixups_visited.push_back(fixup_it->second.visited);
+
+    code_size += block->size();
+  }
+
+  // Shard the code blocks into contiguous address ranges within each section,
+  // aiming for shards of roughly equal size.
+  std::vector<DisassemblyState*> sorted_states(states);
+  std::sort(sorted_states.begin(), sorted_states.end(),
+            &DisassemblyStateAddressLess);
+  size_t shard_size = code_size /
+      (disassembly_threads_ * kDisassemblyShardsPerThread) + 1;
+
+  ScopedVector<core::ClosureDelegate> shards;
+  size_t shard_begin = 0;
+  size_t shard_bytes = 0;
+  for (size_t i = 0; i < sorted_states.size(); ++i) {
+    shard_bytes += sorted_states[i]->block->size();
+
+    bool last = i + 1 == sorted_states.size();
+    if (!last && shard_bytes < shard_size &&
+        sorted_states[i + 1]->block->section() ==
+            sorted_states[i]->block->section()) {
+      continue;
+    }
+
+    DisassemblyState* const* begin = &sorted_states[0] + shard_begin;
+    DisassemblyState* const* end = &sorted_states[0] + i + 1;
+    shards.push_back(new core::ClosureDelegate(
+        base::Bind(&Decomposer::DisassembleShard, base::Unretained(this),
+                   begin, end)));
+    shard_begin = i + 1;
+    shard_bytes = 0;
+  }
+
+  VLOG(1) << "Disassembling " << states.size() << " code blocks in "
+          << shards.size() << " shards on " << disassembly_threads_
+          << " threads.";
+
+  // Disassemble all of the shards. While this is in progress the block graph,
+  // the image layout and the decomposer's maps are only ever read.
+  base::DelegateSimpleThreadPool pool("Decomposer",
+                                      static_cast<int>(disassembly_threads_));
+  pool.Start();
+  for (size_t i = 0; i < shards.size(); ++i)
+    pool.AddWork(shards[i]);
+  pool.JoinAll();
+
+  // Merge the results in block ID order, exactly as a single-threaded
+  // decomposition would have applied them.
+  for (size_t i = 0; i < states.size(); ++i) {
+    if (!MergeDisassemblyState(states[i]))
+      return false;
+  }
+
+  return true;
+}
+
+void Decomposer::DisassembleShard(DisassemblyState* const* begin,
+                                  DisassemblyState* const* end) {
+  for (; begin != end; ++begin)
+    (*begin)->result = CreateCodeReferencesForBlock(*begin);
+}
+
+bool Decomposer::MergeDisassemblyState(DisassemblyState* state) {
+  DCHECK(state != NULL);
+  BlockGraph::Block* block = state->block;
+
+  if (state->speculative) {
+    // The speculative walk observed the basic-block safety of other code blocks
+    // as it was prior to any disassembly. As we merge in order, the blocks that
+    // precede this one now carry their final attributes while the others are
+    // untouched, which is exactly what a single-threaded walk would observe. If
+    // any observation no longer holds, the walk has to be redone.
+    bool redo = false;
+    for (size_t i = 0; i < state->dependencies.size(); ++i) {
+      const DisassemblyState::Dependency& dependency = state->dependencies[i];
+      if (block_graph::CodeBlockAttributesAreBasicBlockSafe(dependency.first) !=
+              dependency.second) {
+        redo = true;
+        break;
+      }
+    }
+
+    if (redo) {
+      VLOG(1) << "Redoing disassembly of block \"" << block->name() << "\".";
+
+      // Roll back the labels and visited fixups of the speculative walk.
+      if (state->labels_saved) {
+        while (!block->labels().empty())
+          CHECK(block->RemoveLabel(block->labels().begin()->first));
+        BlockGraph::Block::LabelMap::const_iterator label_it =
+            state->saved_labels.begin();
+        for (; label_it != state->saved_labels.end(); ++label_it)
+          CHECK(block->SetLabel(label_it->first, label_it->second));
+        state->saved_labels.clear();
+        state->labels_saved = false;
+      }
+      FixupMap::iterator fixup_it = fixup_map_.lower_bound(block->addr());
+      for (size_t i = 0; i < state->saved_fixups_visited.size(); ++i) {
+        fixup_it->second.visited = state->saved_fixups_visited[i];
+        ++fixup_it;
+      }
+
+      // Disassemble the block again, this time directly against the merged
+      // decomposition state.
+      state->attributes = block->attributes();
+      state->strict = true;
+      state->references = &references_;
+      state->local_references.clear();
+      state->speculative = false;
+      state->dependencies.clear();
+      state->result = CreateCodeReferencesForBlock(state);
+    } else {
+      // All of the pre-existing references were copied, so this only adds the
+      // newly created ones.
+      references_.insert(state->local_references.begin(),
+                         state->local_references.end());
+    }
+  }
+
+  block->set_attributes(state->attributes);
+  return state->result;
+}
+
+bool Decomposer::CreateCodeReferencesForBlock(DisassemblyState* state) {
+  DCHECK(state != NULL);
+  DCHECK(state->references != NULL);
+  BlockGraph::Block* block = state->block;
 
   RelativeAddress block_addr;
   if (!image_->GetAddressOf(block, &block_addr)) {
@@ -2069,7 +2347,7 @@ bool Decomposer::CreateCodeReferencesForBlock(BlockGraph::Block* block) {
   }
 
   Disassembler::InstructionCallback on_instruction(
-      base::Bind(&Decomposer::OnInstruction, base::Unretained(this)));
+      base::Bind(&Decomposer::OnInstruction, base::Unretained(this), state));
 
   // Use block labels and code references as starting points for disassembly.
   Disassembler::AddressSet starting_points;
@@ -2081,19 +2359,20 @@ bool Decomposer::CreateCodeReferencesForBlock(BlockGraph::Block* block) {
   if (starting_points.empty() &&
       (block->attributes() & BlockGraph::GAP_BLOCK) == 0) {
     VLOG(1) << "Block \"" << block->name() << "\" has no private symbols.";
-    block->set_attribute(BlockGraph::ERRORED_DISASSEMBLY);
+    state->attributes |= BlockGraph::ERRORED_DISASSEMBLY;
   }
 
   // Determine whether or not we are being strict during disassembly.
-  bool strict = block_graph::CodeBlockAttributesAreBasicBlockSafe(block);
-  be_strict_with_current_block_ = strict;
+  bool strict =
+      block_graph::CodeBlockAttributesAreBasicBlockSafe(state->attributes);
+  state->strict = strict;
 
   // Determine the length of the code portion of the block by trimming off any
   // known trailing data. Also, if we're in strict mode, ensure that our
   // assumption regarding code/data layout is met.
   size_t code_size = 0;
   if (!BlockHasExpectedCodeDataLayout(block, &code_size) &&
-      be_strict_with_current_block_) {
+      state->strict) {
     LOG(ERROR) << "Block \"" << block->name() << "\" has unexpected code/data "
                << "layout.";
     return false;
@@ -2110,17 +2389,15 @@ bool Decomposer::CreateCodeReferencesForBlock(BlockGraph::Block* block) {
   // If we're strict (that is, we're confident that the block was produced by
   // cl.exe), then we can use that knowledge to look for calls that appear to be
   // to non-returning functions that we may not have symbol info for.
-  if (be_strict_with_current_block_)
-    LookForNonReturningFunctions(references_, *image_, current_block_, disasm);
-
-  DCHECK_EQ(block, current_block_);
-  current_block_ = NULL;
-  be_strict_with_current_block_ = true;
+  if (state->strict) {
+    LookForNonReturningFunctions(*state->references, references_, *image_,
+                                 block, state->attributes, disasm);
+  }
 
   switch (result) {
     case Disassembler::kWalkIncomplete:
       // There were computed branches that couldn't be chased down.
-      block->set_attribute(BlockGraph::INCOMPLETE_DISASSEMBLY);
+      state->attributes |= BlockGraph::INCOMPLETE_DISASSEMBLY;
       return true;
 
     case Disassembler::kWalkTerminated:
@@ -2129,14 +2406,14 @@ bool Decomposer::CreateCodeReferencesForBlock(BlockGraph::Block* block) {
       DCHECK(!strict);
       // This means that they code was malformed, or broke some expected
       // conventions. This code is not safe for basic block disassembly.
-      block->set_attribute(BlockGraph::ERRORED_DISASSEMBLY);
+      state->attributes |= BlockGraph::ERRORED_DISASSEMBLY;
       return true;
 
     case Disassembler::kWalkSuccess:
       // Were any bytes in the block not accounted for? This generally means
       // unreachable code, which we see quite often, especially in debug builds.
       if (disasm.code_size() != disasm.disassembled_bytes())
-        block->set_attribute(BlockGraph::INCOMPLETE_DISASSEMBLY);
+        state->attributes |= BlockGraph::INCOMPLETE_DISASSEMBLY;
       return true;
 
     case Disassembler::kWalkError:
@@ -2233,7 +2510,9 @@ BlockGraph::Block* Decomposer::FindOrCreateBlock(
 }
 
 CallbackDirective Decomposer::LookPastInstructionForData(
-    RelativeAddress instr_end) {
+    DisassemblyState* state, RelativeAddress instr_end) {
+  DCHECK(state != NULL);
+
   // If this instruction terminates at a data boundary (ie: the *next*
   // instruction will be data or a reloc), we can be certain that a new
   // lookup table is starting at this address.
@@ -2243,12 +2522,12 @@ CallbackDirective Decomposer::LookPastInstructionForData(
   // Find the block housing the reloc. We expect the reloc to be contained
   // completely within this block.
   BlockGraph::Block* block = image_->GetContainingBlock(instr_end, 4);
-  if (block != current_block_) {
+  if (block != state->block) {
     CHECK(block != NULL);
-    LOG_ERROR_OR_VLOG1(be_strict_with_current_block_)
+    LOG_ERROR_OR_VLOG1(state->strict)
         << "Found an instruction/data boundary between blocks: "
-        << current_block_->name() << " and " << block->name();
-    return AbortOrTerminateDisassembly(be_strict_with_current_block_);
+        << state->block->name() << " and " << block->name();
+    return AbortOrTerminateDisassembly(state->strict);
   }
 
   BlockGraph::Offset offset = instr_end - block->addr();
@@ -2258,15 +2537,22 @@ CallbackDirective Decomposer::LookPastInstructionForData(
   bool have_label = block->GetLabel(offset, &label);
   if (!have_label || !label.has_attributes(
           BlockGraph::DATA_LABEL | BlockGraph::JUMP_TABLE_LABEL)) {
-    LOG_ERROR_OR_VLOG1(be_strict_with_current_block_)
+    LOG_ERROR_OR_VLOG1(state->strict)
         << "Expected there to be a data label marking the jump "
         << "table at " << block->name() << " + " << offset << ".";
 
     // If we're in strict mode, we're a block that obeys standard conventions.
     // Which means we should already be aware of any jump tables in this block.
-    if (be_strict_with_current_block_)
+    if (state->strict)
       return Disassembler::kDirectiveAbort;
 
+    // If this walk may have to be redone, remember the labels as they were
+    // prior to it.
+    if (state->speculative && !state->labels_saved) {
+      state->saved_labels = block->labels();
+      state->labels_saved = true;
+    }
+
     // If we're not in strict mode, add the jump-table label.
     if (have_label) {
       CHECK(block->RemoveLabel(offset));
@@ -2280,9 +2566,9 @@ CallbackDirective Decomposer::LookPastInstructionForData(
   return Disassembler::kDirectiveTerminatePath;
 }
 
-void Decomposer::MarkDisassembledPastEnd() {
-  DCHECK(current_block_ != NULL);
-  current_block_->set_attribute(BlockGraph::DISASSEMBLED_PAST_END);
+void Decomposer::MarkDisassembledPastEnd(DisassemblyState* state) {
+  DCHECK(state != NULL);
+  state->attributes |= BlockGraph::DISASSEMBLED_PAST_END;
   // TODO(chrisha): The entire "disassembled past end" and non-returning
   //     function infrastructure can be ripped out once we rework the BB
   //     disassembler to be straight path, and remove the disassembly phase
@@ -2290,21 +2576,25 @@ void Decomposer::MarkDisassembledPastEnd() {
   //     we simply crank down this log verbosity due to all of the false
   //     positives.
   VLOG(1) << "Disassembled past end of block or into known data for block \""
-          << current_block_->name() << "\" at " << current_block_->addr()
+          << state->block->name() << "\" at " << state->block->addr()
           << ".";
 }
 
 CallbackDirective Decomposer::VisitNonFlowControlInstruction(
-    RelativeAddress instr_start, RelativeAddress instr_end) {
+    DisassemblyState* state,
+    RelativeAddress instr_start,
+    RelativeAddress instr_end) {
+  DCHECK(state != NULL);
+
   // TODO(chrisha): We could walk the operands and follow references
   //     explicitly. If any of them are of reference type and there's no
   //     matching reference, this would be cause to blow up and die (we
   //     should get all of these as relocs and/or fixups).
 
   IntermediateReferenceMap::const_iterator ref_it =
-      references_.upper_bound(instr_start);
+      state->references->upper_bound(instr_start);
   IntermediateReferenceMap::const_iterator ref_end =
-      references_.lower_bound(instr_end);
+      state->references->lower_bound(instr_end);
 
   for (; ref_it != ref_end; ++ref_it) {
     BlockGraph::Block* ref_block = image_->GetContainingBlock(
@@ -2312,7 +2602,7 @@ CallbackDirective Decomposer::VisitNonFlowControlInstruction(
     DCHECK(ref_block != NULL);
 
     // This is an inter-block reference.
-    if (ref_block != current_block_) {
+    if (ref_block != state->block) {
       // There should be no cross-block references to the middle of other
       // code blocks (to the top is fine, as we could be passing around a
       // function pointer). The exception is if the remote block is not
@@ -2320,18 +2610,27 @@ CallbackDirective Decomposer::VisitNonFlowControlInstruction(
       // that act like functions within the body of that block, and referring
       // to them is perfectly fine.
       if (ref_block->type() == BlockGraph::CODE_BLOCK &&
-          ref_it->second.base != ref_block->addr() &&
-          block_graph::CodeBlockAttributesAreBasicBlockSafe(ref_block)) {
-        LOG_ERROR_OR_VLOG1(be_strict_with_current_block_)
-            << "Found a non-control-flow code-block to middle-of-code-block "
-            << "reference from block \"" << current_block_->name()
-            << "\" to block \"" << ref_block->name() << "\".";
-        return AbortOrTerminateDisassembly(be_strict_with_current_block_);
+          ref_it->second.base != ref_block->addr()) {
+        // The safety of the remote block depends on its own disassembly, so
+        // a speculative walk has to remember what it saw.
+        bool safe = block_graph::CodeBlockAttributesAreBasicBlockSafe(
+            ref_block);
+        if (state->speculative) {
+          state->dependencies.push_back(
+              DisassemblyState::Dependency(ref_block, safe));
+        }
+        if (safe) {
+          LOG_ERROR_OR_VLOG1(state->strict)
+              << "Found a non-control-flow code-block to middle-of-code-block "
+              << "reference from block \"" << state->block->name()
+              << "\" to block \"" << ref_block->name() << "\".";
+          return AbortOrTerminateDisassembly(state->strict);
+        }
       }
     } else {
       // This is an intra-block reference.
       BlockGraph::Offset ref_offset =
-          ref_it->second.base - current_block_->addr();
+          ref_it->second.base - state->block->addr();
 
       // If this is to offset zero, we assume we are taking a pointer to
       // ourself, which is safe.
@@ -2339,18 +2638,18 @@ CallbackDirective Decomposer::VisitNonFlowControlInstruction(
         // If this is 'clean' code it should be to data, and there should be a
         // label.
         BlockGraph::Label label;
-        if (!current_block_->GetLabel(ref_offset, &label)) {
-          LOG_ERROR_OR_VLOG1(be_strict_with_current_block_)
+        if (!state->block->GetLabel(ref_offset, &label)) {
+          LOG_ERROR_OR_VLOG1(state->strict)
               << "Found an intra-block data-reference with no label.";
-          return AbortOrTerminateDisassembly(be_strict_with_current_block_);
+          return AbortOrTerminateDisassembly(state->strict);
         } else {
           if (!label.has_attributes(BlockGraph::DATA_LABEL) ||
               label.has_attributes(BlockGraph::CODE_LABEL)) {
-            LOG_ERROR_OR_VLOG1(be_strict_with_current_block_)
+            LOG_ERROR_OR_VLOG1(state->strict)
                 << "Found an intra-block data-like reference to a non-data "
-                << "or code label in block \"" << current_block_->name()
+                << "or code label in block \"" << state->block->name()
                 << "\".";
-            return AbortOrTerminateDisassembly(be_strict_with_current_block_);
+            return AbortOrTerminateDisassembly(state->strict);
           }
         }
       }
@@ -2361,10 +2660,12 @@ CallbackDirective Decomposer::VisitNonFlowControlInstruction(
 }
 
 CallbackDirective Decomposer::VisitPcRelativeFlowControlInstruction(
+    DisassemblyState* state,
     AbsoluteAddress instr_abs,
     RelativeAddress instr_rel,
     const _DInst& instruction,
     bool end_of_code) {
+  DCHECK(state != NULL);
   int fc = META_GET_FC(instruction.meta);
   DCHECK(fc == FC_UNC_BRANCH || fc == FC_CALL || fc == FC_CND_BRANCH);
   DCHECK_EQ(O_PC, instruction.ops[0].type);
@@ -2411,18 +2712,18 @@ CallbackDirective Decomposer::VisitPcRelativeFlowControlInstruction(
   } else {
     // Since we slice by section contributions we no longer see short
     // references across blocks. If we do, bail!
-    if (block != current_block_) {
+    if (block != state->block) {
       LOG(ERROR) << "Found a short PC-relative reference out of block \""
-                 << current_block_->name() << "\".";
+                 << state->block->name() << "\".";
       return Disassembler::kDirectiveAbort;
     }
   }
 
   // Validate or create the reference, as necessary.
   if (!ValidateOrAddReference(mode, src, BlockGraph::PC_RELATIVE_REF, size,
-                              dst, 0, &fixup_map_, &references_)) {
+                              dst, 0, &fixup_map_, state->references)) {
     LOG(ERROR) << "Failed to validate/create reference originating from "
-               << "block \"" << current_block_->name() << "\".";
+               << "block \"" << state->block->name() << "\".";
     return Disassembler::kDirectiveAbort;
   }
 
@@ -2446,13 +2747,16 @@ CallbackDirective Decomposer::VisitPcRelativeFlowControlInstruction(
   // not an unconditional jump and we're at the end of the code for this block
   // then we consider this as disassembling past the end.
   if (fc != FC_UNC_BRANCH && end_of_code)
-    MarkDisassembledPastEnd();
+    MarkDisassembledPastEnd(state);
 
   return Disassembler::kDirectiveContinue;
 }
 
 CallbackDirective Decomposer::VisitIndirectMemoryCallInstruction(
-      const _DInst& instruction, bool end_of_code) {
+    DisassemblyState* state,
+    const _DInst& instruction,
+    bool end_of_code) {
+  DCHECK(state != NULL);
   DCHECK_EQ(FC_CALL, META_GET_FC(instruction.meta));
   DCHECK_EQ(O_DISP, instruction.ops[0].type);
 
@@ -2472,9 +2776,15 @@ CallbackDirective Decomposer::VisitIndirectMemoryCallInstruction(
   // Try to dereference the address of the call instruction. This can fail
   // for blocks that are only initialized at runtime, so we don't fail if
   // we don't find a reference.
-  IntermediateReferenceMap::const_iterator ref_it =
-      references_.find(disp_addr_rel);
-  if (ref_it == references_.end())
+  // References originating in the block being disassembled are tracked
+  // separately when disassembling in parallel. Those originating in other
+  // code blocks may not have been created yet, but disassembly only creates
+  // PC-relative references, which are never the target of an indirect call.
+  const IntermediateReferenceMap* refs = &references_;
+  if (state->block->Contains(disp_addr_rel, kPointerSize))
+    refs = state->references;
+  IntermediateReferenceMap::const_iterator ref_it = refs->find(disp_addr_rel);
+  if (ref_it == refs->end())
     return Disassembler::kDirectiveContinue;
 
   // NOTE: This process derails for bound import tables. In this case the
@@ -2514,13 +2824,16 @@ CallbackDirective Decomposer::VisitIndirectMemoryCallInstruction(
     return Disassembler::kDirectiveTerminatePath;
 
   if (end_of_code)
-    MarkDisassembledPastEnd();
+    MarkDisassembledPastEnd(state);
 
   return Disassembler::kDirectiveContinue;
 }
 
-CallbackDirective Decomposer::OnInstruction(const Disassembler& walker,
+CallbackDirective Decomposer::OnInstruction(DisassemblyState* state,
+                                            const Disassembler& walker,
                                             const _DInst& instruction) {
+  DCHECK(state != NULL);
+
   // Get the relative address of this instruction.
   AbsoluteAddress instr_abs(static_cast<uint32>(instruction.addr));
   RelativeAddress instr_rel;
@@ -2533,8 +2846,8 @@ CallbackDirective Decomposer::OnInstruction(const Disassembler& walker,
 #ifndef NDEBUG
   // If we're in debug mode, it's helpful to have a pointer directly to the
   // beginning of this instruction in memory.
-  BlockGraph::Offset instr_offset = instr_rel - current_block_->addr();
-  const uint8* instr_data = current_block_->data() + instr_offset;
+  BlockGraph::Offset instr_offset = instr_rel - state->block->addr();
+  const uint8* instr_data = state->block->data() + instr_offset;
 #endif
 
   // TODO(chrisha): Certain instructions require aligned data (ie: MMX/SSE
@@ -2542,13 +2855,14 @@ CallbackDirective Decomposer::OnInstruction(const Disassembler& walker,
   //     refer to, and set their alignment appropriately. For now, alignment
   //     is simply preserved from the original image.
 
-  CallbackDirective directive = LookPastInstructionForData(after_instr_rel);
+  CallbackDirective directive = LookPastInstructionForData(state,
+                                                          after_instr_rel);
   if (IsFatalCallbackDirective(directive))
     return directive;
 
   // We're at the end of code in this block if we encountered data, or this is
   // the last instruction to be processed.
-  RelativeAddress block_end(current_block_->addr() + current_block_->size());
+  RelativeAddress block_end(state->block->addr() + state->block->size());
   bool end_of_code = (directive == Disassembler::kDirectiveTerminatePath) ||
       (after_instr_rel >= block_end);
 
@@ -2558,10 +2872,10 @@ CallbackDirective Decomposer::OnInstruction(const Disassembler& walker,
     // There's no control flow and we're at the end of the block. Mark the
     // block as dirty.
     if (end_of_code)
-      MarkDisassembledPastEnd();
+      MarkDisassembledPastEnd(state);
 
     return CombineCallbackDirectives(directive,
-        VisitNonFlowControlInstruction(instr_rel, after_instr_rel));
+        VisitNonFlowControlInstruction(state, instr_rel, after_instr_rel));
   }
 
   if ((fc == FC_UNC_BRANCH || fc == FC_CALL || fc == FC_CND_BRANCH) &&
@@ -2569,7 +2883,8 @@ CallbackDirective Decomposer::OnInstruction(const Disassembler& walker,
     // For all branches, calls and conditional branches to PC-relative
     // addresses, record a PC-relative reference.
     return CombineCallbackDirectives(directive,
-        VisitPcRelativeFlowControlInstruction(instr_abs,
+        VisitPcRelativeFlowControlInstruction(state,
+                                              instr_abs,
                                               instr_rel,
                                               instruction,
                                               end_of_code));
@@ -2580,14 +2895,14 @@ CallbackDirective Decomposer::OnInstruction(const Disassembler& walker,
   // name thunk from another module.
   if (fc == FC_CALL && instruction.ops[0].type == O_DISP) {
     return CombineCallbackDirectives(directive,
-        VisitIndirectMemoryCallInstruction(instruction, end_of_code));
+        VisitIndirectMemoryCallInstruction(state, instruction, end_of_code));
   }
 
   // Look out for blocks where disassembly seems to run off the end of the
   // block. We do not treat interrupts as flow control as execution can
   // continue past the interrupt.
   if (fc != FC_RET && fc != FC_UNC_BRANCH && end_of_code)
-    MarkDisassembledPastEnd();
+    MarkDisassembledPastEnd(state);
 
   return directive;
 }
@@ -2609,6 +2924,11 @@ bool Decomposer::CreatePEImageBlocksAndReferences(
 }
 
 bool Decomposer::FinalizeIntermediateReferences() {
+  // The references are accumulated and set in bulk, which is a lot cheaper
+  // than setting them one at a time.
+  BlockGraph::PendingReferences pending_references;
+  pending_references.reserve(references_.size());
+
   IntermediateReferenceMap::const_iterator it(references_.begin());
   IntermediateReferenceMap::const_iterator end(references_.end());
 
@@ -2641,9 +2961,11 @@ bool Decomposer::FinalizeIntermediateReferences() {
                               dst,
                               dst_offset,
                               dst_base);
-    src->SetReference(src_addr - src_start, ref);
+    pending_references.push_back(std::make_pair(
+        BlockGraph::Block::Referrer(src, src_addr - src_start), ref));
   }
 
+  image_->graph()->SetReferences(&pending_references);
   references_.clear();
 
   return true;
@@ -2749,21 +3071,24 @@ bool Decomposer::CreateSections() {
 bool Decomposer::LoadDebugStreams(IDiaSession* dia_session) {
   DCHECK(dia_session != NULL);
 
-  // Load the fixups. These must exist.
+  // Load the fixups. These must exist. They are read directly from the PDB
+  // file in a single pass, which is much faster than going through DIA.
+  pdb::PdbFile pdb_file;
+  pdb::PdbReader pdb_reader;
+  if (!pdb_reader.Read(pdb_path_, &pdb_file)) {
+    LOG(ERROR) << "Failed to load PDB: " << pdb_path_.value();
+    return false;
+  }
   PdbFixups pdb_fixups;
-  SearchResult search_result = FindAndLoadDiaDebugStreamByName(
-      kFixupDiaDebugStreamName, dia_session, &pdb_fixups);
-  if (search_result != kSearchSucceeded) {
-    if (search_result == kSearchFailed) {
-      LOG(ERROR) << "PDB file does not contain a FIXUP stream. Module must be "
-                    "linked with '/PROFILE' or '/DEBUGINFO:FIXUP' flag.";
-    }
+  if (!pdb::ReadFixupsFromPdbFile(pdb_file, &pdb_fixups)) {
+    LOG(ERROR) << "PDB file does not contain a FIXUP stream. Module must be "
+                  "linked with '/PROFILE' or '/DEBUGINFO:FIXUP' flag.";
     return false;
   }
 
   // Load the omap_from table. It is not necessary that one exist.
   std::vector<OMAP> omap_from;
-  search_result = FindAndLoadDiaDebugStreamByName(
+  SearchResult search_result = FindAndLoadDiaDebugStreamByName(
       kOmapFromDiaDebugStreamName, dia_session, &omap_from);
   if (search_result == kSearchErrored)
     return false;
@@ -2778,6 +3103,8 @@ bool Decomposer::LoadDebugStreams(IDiaSession* dia_session) {
 bool Decomposer::OmapAndValidateFixups(const std::vector<OMAP>& omap_from,
                                        const PdbFixups& pdb_fixups) {
   bool have_omap = omap_from.size() != 0;
+  pdb::OmapTranslator omap_translator;
+  omap_translator.Init(omap_from);
 
   // The resource section in Chrome is modified post-link by a tool that adds a
   // manifest to it. This causes all of the fixups in the resource section (and
@@ -2829,8 +3156,8 @@ bool Decomposer::OmapAndValidateFixups(const std::vector<OMAP>& omap_from,
     RelativeAddress rva_location(pdb_fixups[i].rva_location);
     RelativeAddress rva_base(pdb_fixups[i].rva_base);
     if (have_omap) {
-      rva_location = pdb::TranslateAddressViaOmap(omap_from, rva_location);
-      rva_base = pdb::TranslateAddressViaOmap(omap_from, rva_base);
+      rva_location = omap_translator.Translate(rva_location);
+      rva_base = omap_translator.Translate(rva_base);
     }
 
     // If these are part of the .rsrc section, ignore them.
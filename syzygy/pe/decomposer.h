@@ -50,6 +50,8 @@ class Decomposer {
   struct Fixup;
   // Used for storing references before the block graph is complete.
   struct IntermediateReference;
+  // Used for tracking the disassembly of a single code block.
+  struct DisassemblyState;
 
   typedef block_graph::BlockGraph BlockGraph;
   typedef core::AbsoluteAddress AbsoluteAddress;
@@ -73,6 +75,10 @@ class Decomposer {
   // will be populated with decomposition coverage statistics.
   bool Decompose(ImageLayout* image_layout);
 
+  // @returns true if the last call to Decompose loaded the decomposition from
+  //     the decomposition cache.
+  bool loaded_from_cache() const { return loaded_from_cache_; }
+
   // @{
   // TODO(chrisha): Expose a mechanism for bulk-importing these via some JSON
   //     representation. We will likely want to expose this on the command-line
@@ -122,6 +128,33 @@ class Decomposer {
   // @returns the PDB path.
   const base::FilePath& pdb_path() const { return pdb_path_; }
 
+  // Sets the number of worker threads used to disassemble code blocks. When
+  // this is greater than one, code blocks are sharded into contiguous address
+  // ranges per section and disassembled concurrently. The results are merged
+  // in block ID order, and blocks whose disassembly depended on the outcome of
+  // another block's disassembly are redone, so the decomposition is identical
+  // to the single-threaded one. Defaults to 1.
+  // @param disassembly_threads the number of worker threads to use.
+  void set_disassembly_threads(size_t disassembly_threads) {
+    disassembly_threads_ = disassembly_threads;
+  }
+
+  // @returns the number of worker threads used to disassemble code blocks.
+  size_t disassembly_threads() const { return disassembly_threads_; }
+
+  // Sets the directory of the decomposition cache. If not empty, the
+  // decomposition of an image is looked up in the cache prior to being
+  // performed, and saved to the cache afterwards. This defaults to the value
+  // of the environment variable named by DecompositionCache::kCacheDirEnvVar.
+  // @param cache_dir the decomposition cache directory. May be empty to
+  //     disable the cache.
+  void set_cache_dir(const base::FilePath& cache_dir) {
+    cache_dir_ = cache_dir;
+  }
+
+  // @returns the decomposition cache directory.
+  const base::FilePath& cache_dir() const { return cache_dir_; }
+
  protected:
   typedef std::map<RelativeAddress, std::string> DataLabels;
   typedef std::vector<pdb::PdbFixup> PdbFixups;
@@ -130,6 +163,10 @@ class Decomposer {
   // and validates that the file exists and matches the module.
   bool FindAndValidatePdbPath();
 
+  // Performs the actual decomposition, once a PDB file has been found and no
+  // cached decomposition was available.
+  bool DecomposeImpl(ImageLayout* image_layout);
+
   // Parse functions and thunks, using their data to annotate blocks.
   bool ProcessCodeSymbols(IDiaSymbol* globals);
   // Parses all function symbols.
@@ -218,9 +255,21 @@ class Decomposer {
   bool ValidateRelocs(const PEFile::RelocMap& reloc_map);
   // Disassemble all code blocks and create code->code references.
   bool CreateCodeReferences();
-  // Disassemble @p block and invoke @p on_instruction for each instruction
-  // encountered.
-  bool CreateCodeReferencesForBlock(BlockGraph::Block* block);
+  // Disassembles the code blocks in @p states on a pool of worker threads, and
+  // merges the results in order.
+  bool CreateCodeReferencesInParallel(
+      const std::vector<DisassemblyState*>& states);
+  // Disassembles each of the blocks in the range [@p begin, @p end). This is
+  // the unit of work handed to the disassembly worker threads.
+  void DisassembleShard(DisassemblyState* const* begin,
+                        DisassemblyState* const* end);
+  // Disassemble the block tracked by @p state, accumulating its attributes and
+  // references in @p state.
+  bool CreateCodeReferencesForBlock(DisassemblyState* state);
+  // Applies the results accumulated in @p state to its block. If @p state was
+  // disassembled speculatively in parallel and its outcome depended on blocks
+  // that have since changed, the block is disassembled again first.
+  bool MergeDisassemblyState(DisassemblyState* state);
 
   // Parses the PE BlockGraph header and other important PE structures,
   // adds them as blocks to the image, and creates the references
@@ -261,18 +310,24 @@ class Decomposer {
 
   // @name OnInstruction helper functions.
   // @{
-  void MarkDisassembledPastEnd();
-  CallbackDirective LookPastInstructionForData(RelativeAddress instr_end);
-  CallbackDirective VisitNonFlowControlInstruction(RelativeAddress instr_start,
+  void MarkDisassembledPastEnd(DisassemblyState* state);
+  CallbackDirective LookPastInstructionForData(DisassemblyState* state,
+                                               RelativeAddress instr_end);
+  CallbackDirective VisitNonFlowControlInstruction(DisassemblyState* state,
+                                                   RelativeAddress instr_start,
                                                    RelativeAddress instr_end);
   CallbackDirective VisitPcRelativeFlowControlInstruction(
+      DisassemblyState* state,
       AbsoluteAddress instr_abs,
       RelativeAddress instr_rel,
       const _DInst& instruction,
       bool end_of_code);
   CallbackDirective VisitIndirectMemoryCallInstruction(
-      const _DInst& instruction, bool end_of_code);
-  CallbackDirective OnInstruction(const Disassembler& disassembler,
+      DisassemblyState* state,
+      const _DInst& instruction,
+      bool end_of_code);
+  CallbackDirective OnInstruction(DisassemblyState* state,
+                                  const Disassembler& disassembler,
                                   const _DInst& instruction);
   // @}
 
@@ -344,15 +399,13 @@ class Decomposer {
   typedef std::set<std::string> StringSet;
   typedef std::map<std::string, StringSet> StringSetMap;
 
-  // @name State tracking for the disassembler.
-  // @{
-  // The block we're currently disassembling. We need this for use in the
-  // OnInstruction callback.
-  BlockGraph::Block* current_block_;
-  // Used to indicate the decomposer's handling of the current block. Needed
-  // for OnInstruction callback.
-  bool be_strict_with_current_block_;
-  // @}
+  // The number of worker threads used to disassemble code blocks.
+  size_t disassembly_threads_;
+
+  // The decomposition cache directory. Empty if there is no cache.
+  base::FilePath cache_dir_;
+  // Set to true if the last decomposition was loaded from the cache.
+  bool loaded_from_cache_;
 
   // Keeps track of reloc entry information, which is used by various
   // pieces of the decomposer.
@@ -402,6 +455,50 @@ struct Decomposer::IntermediateReference {
   BlockGraph::Offset offset;
 };
 
+// Tracks the disassembly of a single code block. When disassembling in
+// parallel, everything a walk produces is accumulated here rather than being
+// applied directly to the shared decomposition state.
+struct Decomposer::DisassemblyState {
+  explicit DisassemblyState(BlockGraph::Block* block)
+      : block(block),
+        attributes(block->attributes()),
+        strict(true),
+        references(NULL),
+        speculative(false),
+        labels_saved(false),
+        result(false) {
+  }
+
+  typedef std::pair<const BlockGraph::Block*, bool> Dependency;
+  typedef std::vector<Dependency> Dependencies;
+
+  // The block being disassembled.
+  BlockGraph::Block* block;
+  // The attributes the block will have once this state is merged.
+  BlockGraph::BlockAttributes attributes;
+  // Indicates whether we are being strict with this block.
+  bool strict;
+  // The map into which references originating in this block are created, and
+  // in which references originating in this block are looked up. This is
+  // either the decomposer's map or local_references.
+  IntermediateReferenceMap* references;
+  // The references originating in this block, when disassembling in parallel.
+  IntermediateReferenceMap local_references;
+  // True if this block is being disassembled in parallel with others.
+  bool speculative;
+  // The other code blocks whose basic-block safety was consulted during a
+  // speculative walk, and the value that was observed.
+  Dependencies dependencies;
+  // The labels and fixup-visited flags of the block prior to a speculative
+  // walk. These are used to roll back a walk that must be redone. As labels
+  // are only modified by non-strict walks they are saved lazily.
+  bool labels_saved;
+  BlockGraph::Block::LabelMap saved_labels;
+  std::vector<bool> saved_fixups_visited;
+  // The result of disassembling the block.
+  bool result;
+};
+
 }  // namespace pe
 
 #endif  // SYZYGY_PE_DECOMPOSER_H_
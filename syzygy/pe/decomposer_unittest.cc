@@ -217,6 +217,34 @@ TEST_F(DecomposerTest, DecomposeFailsWithNonexistentPdb) {
   EXPECT_FALSE(decomposer.Decompose(&image_layout));
 }
 
+TEST_F(DecomposerTest, DecomposeInParallelMatchesSerial) {
+  base::FilePath image_path(testing::GetExeRelativePath(testing::kTestDllName));
+  PEFile image_file;
+
+  ASSERT_TRUE(image_file.Init(image_path));
+
+  // Decompose the test image on a single thread.
+  Decomposer serial_decomposer(image_file);
+  EXPECT_EQ(1u, serial_decomposer.disassembly_threads());
+  BlockGraph serial_block_graph;
+  ImageLayout serial_image_layout(&serial_block_graph);
+  ASSERT_TRUE(serial_decomposer.Decompose(&serial_image_layout));
+
+  // And again, using a pool of worker threads for disassembly.
+  Decomposer parallel_decomposer(image_file);
+  parallel_decomposer.set_disassembly_threads(4);
+  EXPECT_EQ(4u, parallel_decomposer.disassembly_threads());
+  BlockGraph parallel_block_graph;
+  ImageLayout parallel_image_layout(&parallel_block_graph);
+  ASSERT_TRUE(parallel_decomposer.Decompose(&parallel_image_layout));
+
+  // The block IDs, attributes, labels and references should all match.
+  block_graph::BlockGraphSerializer bgs;
+  EXPECT_TRUE(::testing::BlockGraphsEqual(serial_block_graph,
+                                          parallel_block_graph,
+                                          bgs));
+}
+
 TEST_F(DecomposerTest, LabelsAndAttributes) {
   base::FilePath image_path(testing::GetExeRelativePath(testing::kTestDllName));
   PEFile image_file;
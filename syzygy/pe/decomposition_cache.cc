@@ -0,0 +1,226 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pe/decomposition_cache.h"
+
+#include "base/environment.h"
+#include "base/file_util.h"
+#include "base/logging.h"
+#include "base/stringprintf.h"
+#include "base/utf_string_conversions.h"
+#include "base/memory/scoped_ptr.h"
+#include "syzygy/common/syzygy_version.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/pdb/pdb_util.h"
+#include "syzygy/pe/serialization.h"
+
+namespace pe {
+
+namespace {
+
+using block_graph::BlockGraphSerializer;
+
+// The extension used for cache entries.
+const wchar_t kCacheEntryExtension[] = L".bg";
+
+}  // namespace
+
+const char DecompositionCache::kCacheDirEnvVar[] =
+    "SYZYGY_DECOMPOSITION_CACHE_DIR";
+
+DecompositionCache::DecompositionCache(const base::FilePath& cache_dir)
+    : cache_dir_(cache_dir) {
+}
+
+void DecompositionCache::GetCacheDirFromEnvironment(
+    base::FilePath* cache_dir) {
+  DCHECK(cache_dir != NULL);
+
+  *cache_dir = base::FilePath();
+
+  scoped_ptr<base::Environment> env(base::Environment::Create());
+  CHECK(env != NULL);
+  std::string value;
+  if (!env->GetVar(kCacheDirEnvVar, &value) || value.empty())
+    return;
+
+  *cache_dir = base::FilePath(UTF8ToWide(value));
+}
+
+bool DecompositionCache::GetKey(const PEFile& pe_file,
+                                const base::FilePath& pdb_path,
+                                std::wstring* key) {
+  DCHECK(key != NULL);
+
+  pdb::PdbInfoHeader70 pdb_header = {};
+  if (!pdb::ReadPdbHeader(pdb_path, &pdb_header)) {
+    LOG(ERROR) << "Unable to read PDB info header from PDB file: "
+               << pdb_path.value();
+    return false;
+  }
+
+  PEFile::Signature signature;
+  pe_file.GetSignature(&signature);
+
+  const GUID& guid = pdb_header.signature;
+  *key = base::StringPrintf(
+      L"%08X%08X%08X%08X-"
+      L"%08X%04X%04X%02X%02X%02X%02X%02X%02X%02X%02X%X-"
+      L"%ls",
+      signature.base_address.value(),
+      signature.module_size,
+      signature.module_time_date_stamp,
+      signature.module_checksum,
+      guid.Data1, guid.Data2, guid.Data3,
+      guid.Data4[0], guid.Data4[1], guid.Data4[2], guid.Data4[3],
+      guid.Data4[4], guid.Data4[5], guid.Data4[6], guid.Data4[7],
+      pdb_header.pdb_age,
+      ASCIIToWide(common::kSyzygyVersion.GetVersionString()).c_str());
+
+  return true;
+}
+
+bool DecompositionCache::GetEntryPath(const PEFile& pe_file,
+                                      const base::FilePath& pdb_path,
+                                      base::FilePath* entry_path) const {
+  DCHECK(entry_path != NULL);
+
+  std::wstring key;
+  if (!GetKey(pe_file, pdb_path, &key))
+    return false;
+
+  // Prefix the key with the module name to make the cache easier to inspect.
+  std::wstring name(pe_file.path().BaseName().value());
+  name.append(L"-");
+  name.append(key);
+  name.append(kCacheEntryExtension);
+  *entry_path = cache_dir_.Append(name);
+
+  return true;
+}
+
+bool DecompositionCache::Load(const PEFile& pe_file,
+                              const base::FilePath& pdb_path,
+                              ImageLayout* image_layout,
+                              bool* loaded) const {
+  DCHECK(image_layout != NULL);
+  DCHECK(loaded != NULL);
+  DCHECK_EQ(0u, image_layout->blocks.graph()->blocks().size());
+
+  *loaded = false;
+
+  base::FilePath entry_path;
+  if (!GetEntryPath(pe_file, pdb_path, &entry_path))
+    return false;
+
+  if (!file_util::PathExists(entry_path)) {
+    VLOG(1) << "No decomposition cache entry at \"" << entry_path.value()
+            << "\".";
+    return true;
+  }
+
+  {
+    file_util::ScopedFILE in_file(file_util::OpenFile(entry_path, "rb"));
+    if (in_file.get() != NULL) {
+      core::FileInStream file_stream(in_file.get());
+      core::BufferedInStream in_stream(&file_stream);
+      core::NativeBinaryInArchive in_archive(&in_stream);
+      BlockGraphSerializer::Attributes attributes = 0;
+      if (LoadBlockGraphAndImageLayout(pe_file, &attributes, image_layout,
+                                       &in_archive)) {
+        LOG(INFO) << "Loaded decomposition from cache entry \""
+                  << entry_path.value() << "\".";
+        *loaded = true;
+        return true;
+      }
+    }
+  }
+
+  // The entry is unusable, so get rid of it. This way the next run will
+  // replace it.
+  LOG(WARNING) << "Unable to load decomposition cache entry \""
+               << entry_path.value() << "\", deleting it.";
+  file_util::Delete(entry_path, false);
+
+  // If nothing made it into the image layout then the caller can simply
+  // decompose the image. Otherwise we have no way of undoing the partial load.
+  if (image_layout->blocks.graph()->blocks().empty() &&
+      image_layout->blocks.address_space_impl().empty() &&
+      image_layout->sections.empty()) {
+    return true;
+  }
+
+  LOG(ERROR) << "Decomposition cache entry \"" << entry_path.value()
+             << "\" is corrupt.";
+  return false;
+}
+
+bool DecompositionCache::Save(const PEFile& pe_file,
+                              const base::FilePath& pdb_path,
+                              const ImageLayout& image_layout) const {
+  base::FilePath entry_path;
+  if (!GetEntryPath(pe_file, pdb_path, &entry_path))
+    return false;
+
+  if (!file_util::CreateDirectory(cache_dir_)) {
+    LOG(ERROR) << "Unable to create decomposition cache directory \""
+               << cache_dir_.value() << "\".";
+    return false;
+  }
+
+  // Write the entry to a temporary file alongside its final location.
+  base::FilePath temp_path;
+  if (!file_util::CreateTemporaryFileInDir(cache_dir_, &temp_path)) {
+    LOG(ERROR) << "Unable to create a temporary file in \""
+               << cache_dir_.value() << "\".";
+    return false;
+  }
+
+  bool saved = false;
+  {
+    file_util::ScopedFILE out_file(file_util::OpenFile(temp_path, "wb"));
+    if (out_file.get() != NULL) {
+      core::FileOutStream file_stream(out_file.get());
+      core::BufferedOutStream out_stream(&file_stream);
+      core::NativeBinaryOutArchive out_archive(&out_stream);
+      saved = SaveBlockGraphAndImageLayout(pe_file, 0, image_layout,
+                                           &out_archive) &&
+          out_archive.Flush();
+    }
+  }
+
+  if (!saved) {
+    LOG(ERROR) << "Unable to write decomposition cache entry \""
+               << temp_path.value() << "\".";
+    file_util::Delete(temp_path, false);
+    return false;
+  }
+
+  // Another process may have populated the entry in the meantime. As entries
+  // are keyed on their content either copy is as good as the other.
+  if (!file_util::Move(temp_path, entry_path)) {
+    file_util::Delete(temp_path, false);
+    if (!file_util::PathExists(entry_path)) {
+      LOG(ERROR) << "Unable to move decomposition cache entry into place at \""
+                 << entry_path.value() << "\".";
+      return false;
+    }
+  }
+
+  LOG(INFO) << "Saved decomposition to cache entry \"" << entry_path.value()
+            << "\".";
+  return true;
+}
+
+}  // namespace pe
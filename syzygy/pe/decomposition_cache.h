@@ -0,0 +1,103 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares DecompositionCache, an on-disk cache of serialized image
+// decompositions. Entries are keyed by the signature of the PE file, the
+// GUID and age of its matching PDB file, and the version of the toolchain that
+// produced them. This allows a sequence of tools operating on the same image
+// to only decompose it once.
+
+#ifndef SYZYGY_PE_DECOMPOSITION_CACHE_H_
+#define SYZYGY_PE_DECOMPOSITION_CACHE_H_
+
+#include <string>
+
+#include "base/files/file_path.h"
+#include "syzygy/pe/image_layout.h"
+#include "syzygy/pe/pe_file.h"
+
+namespace pe {
+
+class DecompositionCache {
+ public:
+  // The name of the environment variable that may be used to specify a cache
+  // directory to the tools that decompose images.
+  static const char kCacheDirEnvVar[];
+
+  // Creates a cache rooted at @p cache_dir. The directory will be created the
+  // first time an entry is saved to it.
+  // @param cache_dir the directory housing the cache entries.
+  explicit DecompositionCache(const base::FilePath& cache_dir);
+
+  // Gets the cache directory specified in the environment, if any.
+  // @param cache_dir will receive the cache directory. This is left empty if
+  //     the environment does not specify a cache directory.
+  static void GetCacheDirFromEnvironment(base::FilePath* cache_dir);
+
+  // Builds the key identifying the decomposition of a given image.
+  // @param pe_file the image file.
+  // @param pdb_path the path to the PDB file matching @p pe_file.
+  // @param key will receive the key.
+  // @returns true on success, false otherwise.
+  static bool GetKey(const PEFile& pe_file,
+                     const base::FilePath& pdb_path,
+                     std::wstring* key);
+
+  // Gets the path of the cache entry for a given image.
+  // @param pe_file the image file.
+  // @param pdb_path the path to the PDB file matching @p pe_file.
+  // @param entry_path will receive the path to the cache entry.
+  // @returns true on success, false otherwise.
+  bool GetEntryPath(const PEFile& pe_file,
+                    const base::FilePath& pdb_path,
+                    base::FilePath* entry_path) const;
+
+  // Attempts to load the decomposition of @p pe_file from the cache.
+  // @param pe_file the image file. This must outlive @p image_layout, as the
+  //     loaded blocks will refer to its data.
+  // @param pdb_path the path to the PDB file matching @p pe_file.
+  // @param image_layout the empty image layout to be populated.
+  // @param loaded will be set to true if the decomposition was loaded from
+  //     the cache, false if there was no usable entry.
+  // @returns true on success, false if a matching entry was found but failed
+  //     to load. In that case @p image_layout may be partially populated and
+  //     the offending entry is deleted.
+  bool Load(const PEFile& pe_file,
+            const base::FilePath& pdb_path,
+            ImageLayout* image_layout,
+            bool* loaded) const;
+
+  // Saves the decomposition of @p pe_file in the cache. The entry is written
+  // to a temporary file and then moved into place, so concurrent users of the
+  // cache never observe a partially written entry.
+  // @param pe_file the image file.
+  // @param pdb_path the path to the PDB file matching @p pe_file.
+  // @param image_layout the decomposition of @p pe_file.
+  // @returns true on success, false otherwise.
+  bool Save(const PEFile& pe_file,
+            const base::FilePath& pdb_path,
+            const ImageLayout& image_layout) const;
+
+  // @returns the directory housing the cache entries.
+  const base::FilePath& cache_dir() const { return cache_dir_; }
+
+ private:
+  base::FilePath cache_dir_;
+
+  DISALLOW_COPY_AND_ASSIGN(DecompositionCache);
+};
+
+}  // namespace pe
+
+#endif  // SYZYGY_PE_DECOMPOSITION_CACHE_H_
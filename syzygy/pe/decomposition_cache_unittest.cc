@@ -0,0 +1,150 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pe/decomposition_cache.h"
+
+#include "base/file_util.h"
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/block_graph_serializer.h"
+#include "syzygy/block_graph/unittest_util.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/pe/decomposer.h"
+#include "syzygy/pe/unittest_util.h"
+
+namespace pe {
+
+namespace {
+
+using block_graph::BlockGraph;
+
+class DecompositionCacheTest : public testing::PELibUnitTest {
+  typedef testing::PELibUnitTest Super;
+
+ public:
+  void SetUp() {
+    Super::SetUp();
+
+    ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir_));
+    cache_dir_ = temp_dir_.Append(L"cache");
+
+    image_path_ = testing::GetExeRelativePath(testing::kTestDllName);
+    pdb_path_ = testing::GetExeRelativePath(testing::kTestDllPdbName);
+    ASSERT_TRUE(image_file_.Init(image_path_));
+  }
+
+  base::FilePath temp_dir_;
+  base::FilePath cache_dir_;
+  base::FilePath image_path_;
+  base::FilePath pdb_path_;
+  PEFile image_file_;
+};
+
+}  // namespace
+
+TEST_F(DecompositionCacheTest, GetKey) {
+  std::wstring key1;
+  ASSERT_TRUE(DecompositionCache::GetKey(image_file_, pdb_path_, &key1));
+  EXPECT_FALSE(key1.empty());
+
+  // The key is a function of the inputs only.
+  std::wstring key2;
+  ASSERT_TRUE(DecompositionCache::GetKey(image_file_, pdb_path_, &key2));
+  EXPECT_EQ(key1, key2);
+
+  // A missing PDB can't produce a key.
+  base::FilePath bad_pdb_path(temp_dir_.Append(L"nonexistent.pdb"));
+  EXPECT_FALSE(DecompositionCache::GetKey(image_file_, bad_pdb_path, &key2));
+}
+
+TEST_F(DecompositionCacheTest, LoadEmptyCache) {
+  DecompositionCache cache(cache_dir_);
+  EXPECT_EQ(cache_dir_, cache.cache_dir());
+
+  BlockGraph block_graph;
+  ImageLayout image_layout(&block_graph);
+  bool loaded = true;
+  EXPECT_TRUE(cache.Load(image_file_, pdb_path_, &image_layout, &loaded));
+  EXPECT_FALSE(loaded);
+  EXPECT_TRUE(block_graph.blocks().empty());
+}
+
+TEST_F(DecompositionCacheTest, SaveAndLoad) {
+  BlockGraph block_graph;
+  ImageLayout image_layout(&block_graph);
+  Decomposer decomposer(image_file_);
+  decomposer.set_cache_dir(base::FilePath());
+  ASSERT_TRUE(decomposer.Decompose(&image_layout));
+
+  DecompositionCache cache(cache_dir_);
+  ASSERT_TRUE(cache.Save(image_file_, pdb_path_, image_layout));
+
+  base::FilePath entry_path;
+  ASSERT_TRUE(cache.GetEntryPath(image_file_, pdb_path_, &entry_path));
+  EXPECT_TRUE(file_util::PathExists(entry_path));
+
+  BlockGraph cached_block_graph;
+  ImageLayout cached_image_layout(&cached_block_graph);
+  bool loaded = false;
+  ASSERT_TRUE(cache.Load(image_file_, pdb_path_, &cached_image_layout,
+                         &loaded));
+  EXPECT_TRUE(loaded);
+
+  block_graph::BlockGraphSerializer bgs;
+  EXPECT_TRUE(::testing::BlockGraphsEqual(block_graph, cached_block_graph,
+                                          bgs));
+  EXPECT_EQ(image_layout.sections.size(), cached_image_layout.sections.size());
+}
+
+TEST_F(DecompositionCacheTest, CorruptEntryIsDeleted) {
+  DecompositionCache cache(cache_dir_);
+  base::FilePath entry_path;
+  ASSERT_TRUE(cache.GetEntryPath(image_file_, pdb_path_, &entry_path));
+
+  // An entry with an invalid stream version is rejected before anything is
+  // loaded, so the caller can fall back to decomposing the image.
+  ASSERT_TRUE(file_util::CreateDirectory(cache_dir_));
+  static const char kGarbage[] = "garbage";
+  ASSERT_EQ(static_cast<int>(sizeof(kGarbage)),
+            file_util::WriteFile(entry_path, kGarbage, sizeof(kGarbage)));
+
+  BlockGraph block_graph;
+  ImageLayout image_layout(&block_graph);
+  bool loaded = true;
+  EXPECT_TRUE(cache.Load(image_file_, pdb_path_, &image_layout, &loaded));
+  EXPECT_FALSE(loaded);
+  EXPECT_FALSE(file_util::PathExists(entry_path));
+}
+
+TEST_F(DecompositionCacheTest, DecomposerUsesCache) {
+  // The first decomposition populates the cache.
+  BlockGraph block_graph1;
+  ImageLayout image_layout1(&block_graph1);
+  Decomposer decomposer1(image_file_);
+  decomposer1.set_cache_dir(cache_dir_);
+  ASSERT_TRUE(decomposer1.Decompose(&image_layout1));
+  EXPECT_FALSE(decomposer1.loaded_from_cache());
+
+  // The second one loads from it.
+  BlockGraph block_graph2;
+  ImageLayout image_layout2(&block_graph2);
+  Decomposer decomposer2(image_file_);
+  decomposer2.set_cache_dir(cache_dir_);
+  ASSERT_TRUE(decomposer2.Decompose(&image_layout2));
+  EXPECT_TRUE(decomposer2.loaded_from_cache());
+
+  block_graph::BlockGraphSerializer bgs;
+  EXPECT_TRUE(::testing::BlockGraphsEqual(block_graph1, block_graph2, bgs));
+}
+
+}  // namespace pe
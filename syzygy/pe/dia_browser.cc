@@ -14,6 +14,8 @@
 //
 #include "syzygy/pe/dia_browser.h"
 
+#include <algorithm>
+
 #include "base/logging.h"
 
 namespace {
@@ -40,6 +42,12 @@ bool SymTagBitSetContains(SymTagBitSet set, SymTag tag) {
   return set.test(tag - kSymTagBegin);
 }
 
+// Orders memoized children by symbol tag.
+template<typename ChildType>
+bool ChildSymTagLess(const ChildType& child1, const ChildType& child2) {
+  return child1.sym_tag < child2.sym_tag;
+}
+
 }  // namespace
 
 namespace pe {
@@ -451,6 +459,9 @@ class DiaBrowser::PatternBuilder {
   DISALLOW_COPY_AND_ASSIGN(PatternBuilder);
 };
 
+DiaBrowser::DiaBrowser() : memoize_children_(false) {
+}
+
 DiaBrowser::~DiaBrowser() {
   for (size_t i = 0; i < patterns_.size(); ++i)
     delete [] patterns_[i];
@@ -594,6 +605,7 @@ void DiaBrowser::Reset() {
   front_size_.clear();
   stopped_.clear();
   sym_tags_.clear();
+  children_.clear();
 }
 
 DiaBrowser::BrowserDirective DiaBrowser::PushMatch(
@@ -751,6 +763,10 @@ DiaBrowser::BrowserDirective DiaBrowser::BrowseImpl(IDiaSymbol* root,
   if (sym_tags_.size() < depth + 2)
     sym_tags_.resize(depth + 2);
 
+  // Below the root, memoized children are served from a single enumeration.
+  if (memoize_children_ && depth > 0)
+    return BrowseChildren(root, depth);
+
   // If all symbols are accepted, we can use SymTagNull as a wildcard rather
   // than iterating over each individual SymTag.
   if (sym_tags_[depth].count() == sym_tags_[depth].size())
@@ -818,22 +834,35 @@ DiaBrowser::BrowserDirective DiaBrowser::BrowseEnum(
     if (sym_tag != SymTagNull)
       DCHECK_EQ(sym_tag, actual_sym_tag);
 
-    tag_lineage_.back() = actual_sym_tag;
-    symbol_lineage_.back() = symbol;
-
-    // Try to extend the match using this symbol. If this succeeds, recurse.
-    directive = PushMatch(actual_sym_tag, symbol_id, &sym_tags_[depth + 1]);
-    if (directive == kBrowserContinue)
-      directive = BrowseImpl(symbol.get(), depth + 1);
-    if (directive == kBrowserTerminateAll || directive == kBrowserAbort) {
-      // We've terminated the search already, so we don't need to invoke the
-      // pop callbacks.
-      PopMatch(false);
+    directive = BrowseSymbol(actual_sym_tag, symbol_id, symbol, depth);
+    if (directive == kBrowserTerminateAll || directive == kBrowserAbort)
       break;
-    }
+  }
+
+  tag_lineage_.pop_back();
+  symbol_lineage_.pop_back();
+
+  return directive;
+}
+
+DiaBrowser::BrowserDirective DiaBrowser::BrowseChildren(IDiaSymbol* root,
+                                                        size_t depth) {
+  const ChildVector* children = NULL;
+  if (!GetChildren(root, &children))
+    return kBrowserAbort;
+  DCHECK(children != NULL);
+
+  BrowserDirective directive = kBrowserContinue;
+  tag_lineage_.push_back(SymTagNull);
+  symbol_lineage_.push_back(SymbolPtr());
+
+  for (size_t i = 0; i < children->size(); ++i) {
+    const Child& child = (*children)[i];
+    if (!SymTagBitSetContains(sym_tags_[depth], child.sym_tag))
+      continue;
 
-    // Roll back the search front, and terminate the search if need be.
-    directive = PopMatch(true);
+    directive = BrowseSymbol(child.sym_tag, child.symbol_id, child.symbol,
+                             depth);
     if (directive == kBrowserTerminateAll || directive == kBrowserAbort)
       break;
   }
@@ -844,6 +873,99 @@ DiaBrowser::BrowserDirective DiaBrowser::BrowseEnum(
   return directive;
 }
 
+DiaBrowser::BrowserDirective DiaBrowser::BrowseSymbol(SymTag sym_tag,
+                                                      uint32 symbol_id,
+                                                      const SymbolPtr& symbol,
+                                                      size_t depth) {
+  DCHECK(!tag_lineage_.empty());
+  DCHECK(!symbol_lineage_.empty());
+
+  tag_lineage_.back() = sym_tag;
+  symbol_lineage_.back() = symbol;
+
+  // Try to extend the match using this symbol. If this succeeds, recurse.
+  BrowserDirective directive =
+      PushMatch(sym_tag, symbol_id, &sym_tags_[depth + 1]);
+  if (directive == kBrowserContinue)
+    directive = BrowseImpl(symbol.get(), depth + 1);
+  if (directive == kBrowserTerminateAll || directive == kBrowserAbort) {
+    // We've terminated the search already, so we don't need to invoke the
+    // pop callbacks.
+    PopMatch(false);
+    return directive;
+  }
+
+  // Roll back the search front, and terminate the search if need be.
+  return PopMatch(true);
+}
+
+bool DiaBrowser::GetChildren(IDiaSymbol* root, const ChildVector** children) {
+  DCHECK(root != NULL);
+  DCHECK(children != NULL);
+
+  DWORD root_id = 0;
+  if (FAILED(root->get_symIndexId(&root_id))) {
+    LOG(ERROR) << "Failed to get DIA symbol ID.";
+    return false;
+  }
+
+  // Have we already enumerated the children of this symbol?
+  std::map<uint32, ChildVector>::iterator it = children_.find(root_id);
+  if (it != children_.end()) {
+    *children = &it->second;
+    return true;
+  }
+
+  ChildVector new_children;
+  ScopedComPtr<IDiaEnumSymbols> enum_symbols;
+  HRESULT hr = root->findChildren(SymTagNull,
+                                  NULL,
+                                  nsNone,
+                                  enum_symbols.Receive());
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failed to get DIA symbol enumerator: " << hr << ".";
+    return false;
+  }
+
+  // As in BrowseEnum, a NULL enum is the same as an empty one.
+  while (enum_symbols.get() != NULL) {
+    Child child = {};
+    ULONG fetched = 0;
+    hr = enum_symbols->Next(1, child.symbol.Receive(), &fetched);
+    if (FAILED(hr)) {
+      LOG(ERROR) << "Failed to enumerate DIA symbols: " << hr << ".";
+      return false;
+    }
+    if (fetched == 0)
+      break;
+
+    DWORD symbol_id = 0;
+    DWORD sym_tag = SymTagNull;
+    if (FAILED(child.symbol->get_symIndexId(&symbol_id)) ||
+        FAILED(child.symbol->get_symTag(&sym_tag))) {
+      NOTREACHED() << "Failed to get symbol properties.";
+      return false;
+    }
+
+    // Symbols with tags we don't know about can never be matched.
+    if (sym_tag < kSymTagBegin || sym_tag >= kSymTagEnd)
+      continue;
+
+    child.sym_tag = static_cast<SymTag>(sym_tag);
+    child.symbol_id = symbol_id;
+    new_children.push_back(child);
+  }
+
+  // Keep the order in which DIA returns symbols of the same tag.
+  std::stable_sort(new_children.begin(), new_children.end(),
+                   ChildSymTagLess<Child>);
+
+  it = children_.insert(std::make_pair(root_id, ChildVector())).first;
+  it->second.swap(new_children);
+  *children = &it->second;
+  return true;
+}
+
 namespace builder {
 
 typedef DiaBrowser::PatternBuilder PatternBuilder;
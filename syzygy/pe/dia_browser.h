@@ -32,6 +32,7 @@
 #include <limits.h>
 #include <windows.h>
 #include <bitset>
+#include <map>
 #include <set>
 #include <utility>
 #include <vector>
@@ -105,8 +106,24 @@ class DiaBrowser {
   // a tree of IDiaSymbols.
   class PatternBuilder;
 
+  DiaBrowser();
   ~DiaBrowser();
 
+  // @{
+  // Controls the memoization of symbol children. When enabled, the children
+  // of each symbol below the root are enumerated at most once per call to
+  // Browse, using a single DIA enumeration for all of the symbol tags that
+  // are searched for. This saves COM calls when several tags are searched for
+  // beneath the same symbol, or when symbols are reached along several paths,
+  // at the cost of holding on to the children until Browse returns. Children
+  // of the same symbol are then visited in order of increasing symbol tag.
+  // Defaults to false.
+  void set_memoize_children(bool memoize_children) {
+    memoize_children_ = memoize_children;
+  }
+  bool memoize_children() const { return memoize_children_; }
+  // @}
+
   // Adds a pattern to the DiaBrowser. Returns false if the given pattern
   // can't be added. Currently, this will only occur if the given pattern
   // allows a null match. More precisely, a pattern will match null if the
@@ -183,6 +200,37 @@ class DiaBrowser {
   // kBrowserContinue, kBrowserTerminateAll, or kBrowserAbort.
   BrowserDirective BrowseEnum(IDiaSymbol* root, size_t depth, SymTag sym_tag);
 
+  // This iterates the memoized children of @p root that match the symbol tags
+  // searched for at @p depth. Used in place of BrowseEnum when memoizing.
+  // This can return a reduced subset of BrowserDirective, namely:
+  // kBrowserContinue, kBrowserTerminateAll, or kBrowserAbort.
+  BrowserDirective BrowseChildren(IDiaSymbol* root, size_t depth);
+
+  // Tries to extend the current matches with @p symbol, recursing into its
+  // children if any match is extended. The symbol is stored in the last
+  // entry of the lineages, which the caller must have pushed.
+  // This can return a reduced subset of BrowserDirective, namely:
+  // kBrowserContinue, kBrowserTerminateAll, or kBrowserAbort.
+  BrowserDirective BrowseSymbol(SymTag sym_tag,
+                                uint32 symbol_id,
+                                const SymbolPtr& symbol,
+                                size_t depth);
+
+  // A memoized child of a symbol.
+  struct Child {
+    SymTag sym_tag;
+    uint32 symbol_id;
+    SymbolPtr symbol;
+  };
+  typedef std::vector<Child> ChildVector;
+
+  // Gets the children of @p root, enumerating them if this hasn't been done
+  // yet during this browse.
+  // @param root the symbol whose children are to be returned.
+  // @param children is set to the children of @p root, sorted by symbol tag.
+  // @returns true on success, false otherwise.
+  bool GetChildren(IDiaSymbol* root, const ChildVector** children);
+
   // The set of visited nodes. The first parameter is the address of the
   // element that matched, the second is the actual ID of the visited node.
   // The PDB has cyclic connections, so we must use some form of limiting to
@@ -217,6 +265,12 @@ class DiaBrowser {
   // level of recursion. We use a single vector of these to minimize
   // reallocation at every call to BrowseImpl.
   std::vector<SymTagBitSet> sym_tags_;
+
+  // Indicates whether symbol children are memoized.
+  bool memoize_children_;
+
+  // The memoized children of the symbols browsed so far, keyed by symbol ID.
+  std::map<uint32, ChildVector> children_;
 };
 
 // The builder namespace contains the factory functions that are used to create
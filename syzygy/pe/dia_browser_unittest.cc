@@ -422,6 +422,21 @@ TEST_F(DiaBrowserTest, AllDataSymbolsExploredWithPopCallbacks) {
   dia_browser.Browse(global_.get());
 }
 
+TEST_F(DiaBrowserTest, AllDataSymbolsExploredMemoized) {
+  TestDiaBrowser dia_browser;
+  dia_browser.set_memoize_children(true);
+  EXPECT_TRUE(dia_browser.memoize_children());
+
+  // Search for (Wildcard)*.Data, with pop callbacks.
+  dia_browser.AddPattern(Seq(Star(SymTagNull), SymTagData),
+                         on_full_match_, on_full_match_);
+
+  // The same symbols are found as without memoization.
+  EXPECT_CALL(*this, OnFullMatch(_, _, _)).Times(2 * 2883).
+      WillRepeatedly(Return(DiaBrowser::kBrowserContinue));
+  EXPECT_TRUE(dia_browser.Browse(global_.get()));
+}
+
 TEST_F(DiaBrowserTest, SomePathsTerminated) {
   TestDiaBrowser dia_browser;
 
@@ -448,4 +463,24 @@ TEST_F(DiaBrowserTest, SomePathsTerminated) {
   dia_browser.Browse(global_.get());
 }
 
+TEST_F(DiaBrowserTest, SomePathsTerminatedMemoized) {
+  TestDiaBrowser dia_browser;
+  dia_browser.set_memoize_children(true);
+
+  // The same search as above, with the UDT paths terminated.
+  dia_browser.AddPattern(Seq(Callback(Or(SymTagEnum, SymTagUDT),
+                                      on_partial_match_term_),
+                             SymTagData),
+                         on_full_match_);
+
+  static const size_t kNumPartialMatches = 174;
+  static const size_t kNumFullMatches = 428;
+
+  EXPECT_CALL(*this, OnPartialMatch(_, _, _)).Times(kNumPartialMatches).
+      WillRepeatedly(Return(DiaBrowser::kBrowserContinue));
+  EXPECT_CALL(*this, OnFullMatch(_, _, _)).Times(kNumFullMatches).
+      WillRepeatedly(Return(DiaBrowser::kBrowserContinue));
+  EXPECT_TRUE(dia_browser.Browse(global_.get()));
+}
+
 }  // namespace pe
@@ -18,9 +18,13 @@
 
 #include "syzygy/pe/find.h"
 
+#include <map>
+
 #include "base/environment.h"
 #include "base/file_util.h"
 #include "base/logging.h"
+#include "base/string_util.h"
+#include "base/stringprintf.h"
 #include "base/utf_string_conversions.h"
 #include "base/strings/string_split.h"
 #include "sawbuck/common/com_utils.h"
@@ -60,21 +64,45 @@ bool GetEnvVar(const char* name, std::wstring* value) {
   return true;
 }
 
+// Maps signature keys to the paths where matching files were last found.
+typedef std::map<std::wstring, base::FilePath> FindCache;
+
+// @returns true if @p pdb_path exists and matches @p pdb_info.
+bool PdbFileMatches(const base::FilePath& pdb_path, const PdbInfo& pdb_info) {
+  if (!file_util::PathExists(pdb_path))
+    return false;
+
+  pdb::PdbInfoHeader70 pdb_header;
+  if (!pdb::ReadPdbHeader(pdb_path, &pdb_header))
+    return false;
+  return pdb_info.IsConsistent(pdb_header);
+}
+
+// @returns true if @p pe_path exists and matches @p pe_signature. The base
+//     address and path of the signature are ignored.
+bool PeFileMatches(const base::FilePath& pe_path,
+                   const PEFile::Signature& pe_signature) {
+  if (!file_util::PathExists(pe_path))
+    return false;
+
+  PEFile pe_file;
+  if (!pe_file.Init(pe_path))
+    return false;
+  PEFile::Signature pe_sig;
+  pe_file.GetSignature(&pe_sig);
+
+  return pe_sig.module_checksum == pe_signature.module_checksum &&
+      pe_sig.module_size == pe_signature.module_size &&
+      pe_sig.module_time_date_stamp == pe_signature.module_time_date_stamp;
+}
+
 // Return TRUE to continue searching, FALSE if we want the search to stop.
 BOOL CALLBACK FindPdbFileCallback(PCTSTR path, PVOID context) {
   DCHECK(path != NULL);
   DCHECK(context != NULL);
 
-  base::FilePath pdb_path(path);
   const PdbInfo* pdb_info = static_cast<PdbInfo*>(context);
-
-  pdb::PdbInfoHeader70 pdb_header;
-  if (!pdb::ReadPdbHeader(pdb_path, &pdb_header))
-    return TRUE;
-  if (!pdb_info->IsConsistent(pdb_header))
-    return TRUE;
-
-  return FALSE;
+  return PdbFileMatches(base::FilePath(path), *pdb_info) ? FALSE : TRUE;
 }
 
 // Return TRUE to continue searching, FALSE if we want the search to stop.
@@ -82,23 +110,116 @@ BOOL CALLBACK FindPeFileCallback(PCTSTR path, PVOID context) {
   DCHECK(path != NULL);
   DCHECK(context != NULL);
 
-  base::FilePath pe_path(path);
   const PEFile::Signature* pe_info = static_cast<PEFile::Signature*>(context);
+  return PeFileMatches(base::FilePath(path), *pe_info) ? FALSE : TRUE;
+}
 
-  PEFile pe_file;
-  if (!pe_file.Init(pe_path))
-    return TRUE;
-  PEFile::Signature pe_sig;
-  pe_file.GetSignature(&pe_sig);
+// @returns the key under which the location of the PDB described by
+//     @p pdb_info is remembered.
+std::wstring GetPdbCacheKey(const PdbInfo& pdb_info) {
+  wchar_t guid[40] = {};
+  ::StringFromGUID2(pdb_info.signature(), guid, arraysize(guid));
+  return base::StringPrintf(L"pdb:%ls:%X", guid, pdb_info.pdb_age());
+}
+
+// @returns the key under which the location of the module described by
+//     @p module_signature is remembered.
+std::wstring GetPeCacheKey(const PEFile::Signature& module_signature) {
+  std::wstring name(
+      base::FilePath(module_signature.path).BaseName().value());
+  return base::StringPrintf(L"pe:%ls:%08X:%08X:%08X",
+                            StringToLowerASCII(name).c_str(),
+                            module_signature.module_time_date_stamp,
+                            module_signature.module_size,
+                            module_signature.module_checksum);
+}
+
+// Gets the path of the file in which search results are remembered.
+// @param cache_path Is set to the path of the file, or is left empty if
+//     search results aren't to be remembered.
+// @returns true on success, false otherwise.
+bool GetCachePath(base::FilePath* cache_path) {
+  DCHECK(cache_path != NULL);
 
-  // We don't care about the base address or the path.
-  if (pe_sig.module_checksum != pe_info->module_checksum ||
-      pe_sig.module_size != pe_info->module_size ||
-      pe_sig.module_time_date_stamp != pe_info->module_time_date_stamp) {
-    return TRUE;
+  std::wstring path;
+  if (!GetEnvVar(kFindCacheEnvVar, &path))
+    return false;
+  *cache_path = base::FilePath(path);
+  return true;
+}
+
+// Reads the remembered search results from @p cache_path. A missing or
+// malformed file simply yields fewer entries.
+void ReadCache(const base::FilePath& cache_path, FindCache* cache) {
+  DCHECK(cache != NULL);
+
+  std::string contents;
+  if (!file_util::ReadFileToString(cache_path, &contents))
+    return;
+
+  // Each line is a key and a path, separated by a tab.
+  std::vector<std::string> lines;
+  base::SplitString(contents, '\n', &lines);
+  for (size_t i = 0; i < lines.size(); ++i) {
+    size_t tab = lines[i].find('\t');
+    if (tab == std::string::npos)
+      continue;
+    std::wstring key(UTF8ToWide(lines[i].substr(0, tab)));
+    std::wstring path(UTF8ToWide(lines[i].substr(tab + 1)));
+    (*cache)[key] = base::FilePath(path);
+  }
+}
+
+// Writes @p cache to @p cache_path. Concurrent writers may lose each other's
+// entries, which only costs a search later on.
+void WriteCache(const base::FilePath& cache_path, const FindCache& cache) {
+  std::string contents;
+  FindCache::const_iterator it = cache.begin();
+  for (; it != cache.end(); ++it) {
+    contents.append(WideToUTF8(it->first));
+    contents.push_back('\t');
+    contents.append(WideToUTF8(it->second.value()));
+    contents.push_back('\n');
+  }
+
+  int size = static_cast<int>(contents.size());
+  if (file_util::WriteFile(cache_path, contents.data(), size) != size) {
+    LOG(WARNING) << "Unable to write \"" << cache_path.value() << "\".";
   }
+}
+
+// Looks up the path remembered for @p key, if any.
+// @returns true if a path was remembered, false otherwise.
+bool LookupCachedPath(const std::wstring& key, base::FilePath* path) {
+  DCHECK(path != NULL);
+
+  base::FilePath cache_path;
+  if (!GetCachePath(&cache_path) || cache_path.empty())
+    return false;
+
+  FindCache cache;
+  ReadCache(cache_path, &cache);
+  FindCache::const_iterator it = cache.find(key);
+  if (it == cache.end())
+    return false;
 
-  return FALSE;
+  *path = it->second;
+  return true;
+}
+
+// Remembers @p path as the location of the file described by @p key.
+void UpdateCachedPath(const std::wstring& key, const base::FilePath& path) {
+  base::FilePath cache_path;
+  if (!GetCachePath(&cache_path) || cache_path.empty())
+    return;
+
+  FindCache cache;
+  ReadCache(cache_path, &cache);
+  FindCache::iterator it = cache.find(key);
+  if (it != cache.end() && it->second == path)
+    return;
+  cache[key] = path;
+  WriteCache(cache_path, cache);
 }
 
 bool FindFile(const base::FilePath& file_path,
@@ -167,6 +288,8 @@ bool FindFile(const base::FilePath& file_path,
 
 }  // namespace
 
+const char kFindCacheEnvVar[] = "SYZYGY_FIND_CACHE";
+
 bool PeAndPdbAreMatched(const base::FilePath& pe_path,
                         const base::FilePath& pdb_path) {
   pe::PdbInfo pe_pdb_info;
@@ -185,6 +308,21 @@ bool FindModuleBySignature(const PEFile::Signature& module_signature,
                            base::FilePath* module_path) {
   DCHECK(module_path != NULL);
 
+  // Check the explicit hint directly, then any remembered path. Either is only
+  // used if it matches.
+  std::wstring cache_key(GetPeCacheKey(module_signature));
+  base::FilePath cached_path;
+  if (!module_path->empty() && PeFileMatches(*module_path, module_signature)) {
+    file_util::AbsolutePath(module_path);
+    UpdateCachedPath(cache_key, *module_path);
+    return true;
+  }
+  if (LookupCachedPath(cache_key, &cached_path) &&
+      PeFileMatches(cached_path, module_signature)) {
+    *module_path = cached_path;
+    return true;
+  }
+
   std::vector<base::FilePath> candidate_paths;
   if (!module_path->empty())
     candidate_paths.push_back(*module_path);
@@ -209,8 +347,10 @@ bool FindModuleBySignature(const PEFile::Signature& module_signature,
     }
 
     // If the search was successful we can terminate early.
-    if (!module_path->empty())
+    if (!module_path->empty()) {
+      UpdateCachedPath(cache_key, *module_path);
       return true;
+    }
   }
   DCHECK(module_path->empty());
 
@@ -244,6 +384,21 @@ bool FindPdbForModule(const base::FilePath& module_path,
     return false;
   candidate_paths.push_back(pdb_info.pdb_file_name());
 
+  // Check the explicit hint directly, then any remembered path. Either is only
+  // used if it matches.
+  std::wstring cache_key(GetPdbCacheKey(pdb_info));
+  base::FilePath cached_path;
+  if (!pdb_path->empty() && PdbFileMatches(*pdb_path, pdb_info)) {
+    file_util::AbsolutePath(pdb_path);
+    UpdateCachedPath(cache_key, *pdb_path);
+    return true;
+  }
+  if (LookupCachedPath(cache_key, &cached_path) &&
+      PdbFileMatches(cached_path, pdb_info)) {
+    *pdb_path = cached_path;
+    return true;
+  }
+
   // Prepend the module path to the symbol path.
   std::wstring search_path(module_path.DirName().value());
   search_path.append(L";");
@@ -264,8 +419,10 @@ bool FindPdbForModule(const base::FilePath& module_path,
     }
 
     // If the search was successful we can terminate early.
-    if (!pdb_path->empty())
+    if (!pdb_path->empty()) {
+      UpdateCachedPath(cache_key, *pdb_path);
       return true;
+    }
   }
   DCHECK(pdb_path->empty());
 
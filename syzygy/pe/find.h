@@ -24,6 +24,14 @@
 
 namespace pe {
 
+// The name of the environment variable that may be used to name a file in
+// which the results of FindModuleBySignature and FindPdbForModule are
+// remembered across invocations. Remembered paths are checked before any
+// searching is done, and are only used if the file they refer to still
+// matches the requested signature. If the variable is not set no results are
+// remembered.
+extern const char kFindCacheEnvVar[];
+
 // Determines if the given PE file and PDB file are indeed matched. Does no
 // logging.
 // @param pe_path the path to the PE file to inspect.
@@ -45,6 +53,10 @@ bool PeAndPdbAreMatched(const base::FilePath& pe_path,
 // 2. Looks for "foo.dll" in the current working directory.
 // 3. Looks for "foo.dll" in each directory in @p search_paths.
 //
+// If a path has been remembered for @p module_signature (see
+// kFindCacheEnvVar) it is checked before this search, but after a direct
+// check of @p module_path.
+//
 // @param module_signature The signature of the module we are searching for.
 //     This also contains the path to the module from which the signature was
 //     originally taken, and this is used as the starting point of the search.
@@ -78,6 +90,10 @@ bool FindModuleBySignature(const PEFile::Signature& module_signature,
 // 3. Looks for "foo.pdb" in each directory in @p search_paths, or looks by
 //    GUID/age in each symbol server listed in @p search_paths.
 //
+// If a path has been remembered for the module's GUID/age (see
+// kFindCacheEnvVar) it is checked before this search, but after a direct
+// check of @p pdb_path.
+//
 // @param module_path The module whose PDB file we are looking for.
 // @param search_paths A semi-colon separated list of additional search paths.
 //     May use the svr* and cache* notation of symbol servers.
@@ -14,6 +14,10 @@
 
 #include "syzygy/pe/find.h"
 
+#include "base/environment.h"
+#include "base/file_util.h"
+#include "base/utf_string_conversions.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/win/scoped_handle.h"
 #include "gtest/gtest.h"
 #include "sawbuck/common/com_utils.h"
@@ -29,6 +33,23 @@ class PeFindTest: public testing::PELibUnitTest {
   // Insert your customizations here.
 };
 
+// Points kFindCacheEnvVar at a given file for the lifetime of the object.
+class ScopedFindCache {
+ public:
+  explicit ScopedFindCache(const base::FilePath& cache_path)
+      : env_(base::Environment::Create()) {
+    EXPECT_TRUE(env_->SetVar(kFindCacheEnvVar,
+                             WideToUTF8(cache_path.value())));
+  }
+
+  ~ScopedFindCache() {
+    env_->UnSetVar(kFindCacheEnvVar);
+  }
+
+ private:
+  scoped_ptr<base::Environment> env_;
+};
+
 }  // namespace
 
 TEST_F(PeFindTest, PeAndPdbAreMatchedMissingFiles) {
@@ -118,4 +139,37 @@ TEST_F(PeFindTest, PeFindTestDllPdbWithHint) {
   EXPECT_SAME_FILE(pdb_path, found_path);
 }
 
+TEST_F(PeFindTest, PeFindTestDllPdbRemembered) {
+  const base::FilePath module_path(testing::GetOutputRelativePath(
+      testing::kTestDllName));
+  const base::FilePath pdb_path(testing::GetOutputRelativePath(
+      testing::kTestDllPdbName));
+
+  base::FilePath temp_dir;
+  ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir));
+  const base::FilePath cache_path(temp_dir.Append(L"find_cache.txt"));
+  const base::FilePath copied_pdb_path(temp_dir.Append(
+      testing::kTestDllPdbName));
+  ASSERT_TRUE(file_util::CopyFile(pdb_path, copied_pdb_path));
+
+  ScopedFindCache scoped_find_cache(cache_path);
+
+  // Finding the copy via an explicit hint remembers it.
+  base::FilePath found_path = copied_pdb_path;
+  EXPECT_TRUE(FindPdbForModule(module_path, &found_path));
+  EXPECT_SAME_FILE(copied_pdb_path, found_path);
+  EXPECT_TRUE(file_util::PathExists(cache_path));
+
+  // Without a hint the remembered copy is found ahead of the original.
+  found_path.clear();
+  EXPECT_TRUE(FindPdbForModule(module_path, &found_path));
+  EXPECT_SAME_FILE(copied_pdb_path, found_path);
+
+  // Once the copy is gone the search finds the original again.
+  ASSERT_TRUE(file_util::Delete(copied_pdb_path, false));
+  found_path.clear();
+  EXPECT_TRUE(FindPdbForModule(module_path, &found_path));
+  EXPECT_SAME_FILE(pdb_path, found_path);
+}
+
 }  // namespace pe
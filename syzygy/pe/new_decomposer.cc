@@ -14,13 +14,19 @@
 
 #include "syzygy/pe/new_decomposer.h"
 
+#include <map>
+
 #include "pcrecpp.h"  // NOLINT
 #include "base/bind.h"
+#include "base/bind_helpers.h"
 #include "base/stringprintf.h"
 #include "base/utf_string_conversions.h"
 #include "base/strings/string_split.h"
+#include "base/threading/simple_thread.h"
 #include "base/win/scoped_bstr.h"
 #include "base/win/scoped_comptr.h"
+#include "syzygy/common/stage_profiler.h"
+#include "syzygy/core/closure_delegate.h"
 #include "syzygy/core/disassembler_util.h"
 #include "syzygy/core/zstream.h"
 #include "syzygy/pdb/omap.h"
@@ -127,6 +133,18 @@ struct NewDecomposer::IntermediateReference {
   RelativeAddress dst_addr;
 };
 
+// The debug data and relocs used to create references from fixups. These are
+// loaded on a worker thread while the blocks are being created.
+struct NewDecomposer::FixupData {
+  FixupData() : loaded(false) {
+  }
+
+  std::vector<pdb::PdbFixup> fixups;
+  std::vector<OMAP> omap_from;
+  PEFile::RelocSet reloc_set;
+  bool loaded;
+};
+
 namespace {
 
 using base::win::ScopedBstr;
@@ -286,6 +304,65 @@ bool IsBuiltBySupportedCompiler(IDiaSymbol* compiland) {
   return false;
 }
 
+// Maps compiland names to whether or not they were built by a supported
+// compiler.
+typedef std::map<std::string, bool> CompilandSupportMap;
+
+// Determines which compilands were built by a supported compiler, looking at
+// each compiland only once. Compilands that share a name are only considered
+// supported if all of them are.
+bool GetCompilandSupport(IDiaSession* session,
+                         CompilandSupportMap* compiland_support) {
+  DCHECK(session != NULL);
+  DCHECK(compiland_support != NULL);
+
+  ScopedComPtr<IDiaSymbol> global;
+  HRESULT hr = session->get_globalScope(global.Receive());
+  if (hr != S_OK) {
+    LOG(ERROR) << "Failed to get the DIA global scope: "
+               << com::LogHr(hr) << ".";
+    return false;
+  }
+
+  ScopedComPtr<IDiaEnumSymbols> compilands;
+  hr = global->findChildren(SymTagCompiland, NULL, 0, compilands.Receive());
+  if (hr != S_OK) {
+    LOG(ERROR) << "Failed to enumerate compilands: " << com::LogHr(hr) << ".";
+    return false;
+  }
+
+  while (true) {
+    ScopedComPtr<IDiaSymbol> compiland;
+    ULONG fetched = 0;
+    hr = compilands->Next(1, compiland.Receive(), &fetched);
+    if (FAILED(hr)) {
+      LOG(ERROR) << "Failed to get compiland: " << com::LogHr(hr) << ".";
+      return false;
+    }
+    if (hr != S_OK || fetched == 0)
+      break;
+
+    ScopedBstr bstr_name;
+    if ((hr = compiland->get_name(bstr_name.Receive())) != S_OK) {
+      LOG(ERROR) << "Failed to get compiland name: " << com::LogHr(hr) << ".";
+      return false;
+    }
+    std::string name;
+    if (!WideToUTF8(bstr_name, bstr_name.Length(), &name)) {
+      LOG(ERROR) << "Failed to convert compiland name to UTF8.";
+      return false;
+    }
+
+    bool supported = IsBuiltBySupportedCompiler(compiland.get());
+    std::pair<CompilandSupportMap::iterator, bool> result =
+        compiland_support->insert(std::make_pair(name, supported));
+    if (!result.second)
+      result.first->second = result.first->second && supported;
+  }
+
+  return true;
+}
+
 // Adds an intermediate reference to the provided vector. The vector is
 // specified as the first parameter (in slight violation of our coding
 // standards) because this function is intended to be used by Bind.
@@ -358,31 +435,40 @@ bool CreateReference(RelativeAddress src_addr,
   return true;
 }
 
-// Loads FIXUP and OMAP_FROM debug streams.
-bool LoadDebugStreams(IDiaSession* dia_session,
+// Loads FIXUP and OMAP_FROM debug streams. These are read directly from the
+// PDB file rather than via DIA so that this can be done on a worker thread.
+bool LoadDebugStreams(const pdb::PdbFile& pdb_file,
                       PdbFixups* pdb_fixups,
                       OMAPs* omap_from) {
-  DCHECK(dia_session != NULL);
   DCHECK(pdb_fixups != NULL);
   DCHECK(omap_from != NULL);
 
   // Load the fixups. These must exist.
-  SearchResult search_result = FindAndLoadDiaDebugStreamByName(
-      kFixupDiaDebugStreamName, dia_session, pdb_fixups);
-  if (search_result != kSearchSucceeded) {
-    if (search_result == kSearchFailed) {
-      LOG(ERROR) << "PDB file does not contain a FIXUP stream. Module must be "
-                    "linked with '/PROFILE' or '/DEBUGINFO:FIXUP' flag.";
-    }
+  if (!pdb::ReadFixupsFromPdbFile(pdb_file, pdb_fixups)) {
+    LOG(ERROR) << "PDB file does not contain a FIXUP stream. Module must be "
+                  "linked with '/PROFILE' or '/DEBUGINFO:FIXUP' flag.";
     return false;
   }
 
   // Load the omap_from table. It is not necessary that one exist.
-  search_result = FindAndLoadDiaDebugStreamByName(
-      kOmapFromDiaDebugStreamName, dia_session, omap_from);
-  if (search_result == kSearchErrored) {
-    LOG(ERROR) << "Error trying to read " << kOmapFromDiaDebugStreamName
-               << " stream.";
+  pdb::PdbStream* dbi_stream = pdb_file.GetStream(pdb::kDbiStream);
+  pdb::DbiHeader dbi_header = {};
+  pdb::DbiDbgHeader dbg_header = {};
+  if (dbi_stream == NULL || !dbi_stream->Seek(0) ||
+      !dbi_stream->Read(&dbi_header, 1) ||
+      !dbi_stream->Seek(pdb::GetDbiDbgHeaderOffset(dbi_header)) ||
+      !dbi_stream->Read(&dbg_header, 1)) {
+    LOG(ERROR) << "Unable to read the DBI stream debug header.";
+    return false;
+  }
+  if (dbg_header.omap_from_src < 0)
+    return true;
+  pdb::PdbStream* omap_from_stream =
+      pdb_file.GetStream(dbg_header.omap_from_src);
+  if (omap_from_stream == NULL)
+    return true;
+  if (!omap_from_stream->Seek(0) || !omap_from_stream->Read(omap_from)) {
+    LOG(ERROR) << "Error trying to read OMAPFROM stream.";
     return false;
   }
 
@@ -457,6 +543,8 @@ bool CreateReferencesFromFixupsImpl(
   DCHECK(image != NULL);
 
   bool have_omap = !omap_from.empty();
+  pdb::OmapTranslator omap_translator;
+  omap_translator.Init(omap_from);
   size_t fixups_used = 0;
 
   // The resource section in Chrome is modified post-link by a tool that adds a
@@ -497,8 +585,8 @@ bool CreateReferencesFromFixupsImpl(
     RelativeAddress src_addr(pdb_fixups[i].rva_location);
     RelativeAddress base_addr(pdb_fixups[i].rva_base);
     if (have_omap) {
-      src_addr = pdb::TranslateAddressViaOmap(omap_from, src_addr);
-      base_addr = pdb::TranslateAddressViaOmap(omap_from, base_addr);
+      src_addr = omap_translator.Translate(src_addr);
+      base_addr = omap_translator.Translate(base_addr);
     }
 
     // If the reference originates beyond the .rsrc section then we can't
@@ -1059,6 +1147,8 @@ NewDecomposer::NewDecomposer(const PEFile& image_file)
 bool NewDecomposer::Decompose(ImageLayout* image_layout) {
   DCHECK(image_layout != NULL);
 
+  common::ScopedStageTimer timer("NewDecomposer::Decompose");
+
   // The temporaries should be NULL.
   DCHECK(image_layout_ == NULL);
   DCHECK(image_ == NULL);
@@ -1219,16 +1309,79 @@ bool NewDecomposer::LoadBlockGraphFromPdb(const base::FilePath& pdb_path,
 }
 
 bool NewDecomposer::DecomposeImpl() {
+  // The fixups, OMAP and relocs are read straight from the PDB and image
+  // files and don't depend on DIA or on the blocks, so they are loaded on a
+  // worker thread while we do the rest of the setup.
+  FixupData fixup_data;
+  core::ClosureDelegate fixup_loader(
+      base::Bind(&NewDecomposer::LoadFixupData,
+                 base::ConstRef(image_file_),
+                 base::ConstRef(pdb_path_),
+                 base::Unretained(&fixup_data)));
+  base::DelegateSimpleThread fixup_thread(&fixup_loader, "FixupLoader");
+  fixup_thread.Start();
+
   // Instantiate and initialize our Debug Interface Access session. This logs
   // verbosely for us.
   ScopedComPtr<IDiaDataSource> dia_source;
   ScopedComPtr<IDiaSession> dia_session;
   ScopedComPtr<IDiaSymbol> global;
-  if (!InitializeDia(image_file_, pdb_path_, dia_source.Receive(),
-                     dia_session.Receive(), global.Receive())) {
+  bool blocks_created =
+      InitializeDia(image_file_, pdb_path_, dia_source.Receive(),
+                    dia_session.Receive(), global.Receive()) &&
+      CreateBlocks(dia_session.get());
+
+  // The fixup data must be in hand before going any further, and the worker
+  // must be joined before bailing out as it refers to |fixup_data|.
+  fixup_thread.Join();
+  if (!blocks_created || !fixup_data.loaded)
     return false;
+
+  // Parse the fixups and use them to create references.
+  if (!CreateReferencesFromFixups(&fixup_data))
+    return false;
+
+  // Disassemble code blocks and use the results to infer case and jump tables.
+  if (!DisassembleCodeBlocksAndLabelData())
+    return false;
+
+  // Annotate the block-graph with symbol information.
+  if (parse_debug_info_ && !ProcessSymbols(global.get()))
+    return false;
+
+  return true;
+}
+
+void NewDecomposer::LoadFixupData(const PEFile& image_file,
+                                  const base::FilePath& pdb_path,
+                                  FixupData* fixup_data) {
+  DCHECK(fixup_data != NULL);
+
+  if (!image_file.DecodeRelocs(&fixup_data->reloc_set)) {
+    LOG(ERROR) << "Unable to decode relocs.";
+    return;
+  }
+
+  // This uses its own PdbFile as the underlying file handles can't be shared
+  // with the main thread.
+  pdb::PdbFile pdb_file;
+  pdb::PdbReader pdb_reader;
+  if (!pdb_reader.Read(pdb_path, &pdb_file)) {
+    LOG(ERROR) << "Failed to load PDB: " << pdb_path.value();
+    return;
+  }
+
+  if (!LoadDebugStreams(pdb_file, &fixup_data->fixups,
+                        &fixup_data->omap_from)) {
+    return;
   }
 
+  fixup_data->loaded = true;
+}
+
+bool NewDecomposer::CreateBlocks(IDiaSession* session) {
+  DCHECK(session != NULL);
+
   // Copy the image headers to the layout.
   CopySectionHeadersToImageLayout(
       image_file_.nt_headers()->FileHeader.NumberOfSections,
@@ -1239,46 +1392,32 @@ bool NewDecomposer::DecomposeImpl() {
   if (!CopySectionInfoToBlockGraph(image_file_, image_->graph()))
     return false;
 
-  // We scope the first few operations so that we don't keep the intermediate
-  // references around any longer than we have to.
-  {
-    IntermediateReferences references;
-
-    // First we parse out the PE blocks.
-    if (!CreatePEImageBlocksAndReferences(&references))
-      return false;
-
-    // Now we parse the COFF group symbols from the linker's symbol stream.
-    // These indicate things like static initializers, which must stay together
-    // in a single block.
-    if (!CreateBlocksFromCoffGroups())
-      return false;
+  // We keep the intermediate references local to this function so that we
+  // don't keep them around any longer than we have to.
+  IntermediateReferences references;
 
-    // Next we parse out section contributions. Some of these may coincide with
-    // existing PE parsed blocks, but when they do we expect them to be exact
-    // collisions.
-    if (!CreateBlocksFromSectionContribs(dia_session.get()))
-      return false;
-
-    // Flesh out the rest of the image with gap blocks.
-    if (!CreateGapBlocks())
-      return false;
+  // First we parse out the PE blocks.
+  if (!CreatePEImageBlocksAndReferences(&references))
+    return false;
 
-    // Finalize the PE-parsed intermediate references.
-    if (!FinalizeIntermediateReferences(references))
-      return false;
-  }
+  // Now we parse the COFF group symbols from the linker's symbol stream.
+  // These indicate things like static initializers, which must stay together
+  // in a single block.
+  if (!CreateBlocksFromCoffGroups())
+    return false;
 
-  // Parse the fixups and use them to create references.
-  if (!CreateReferencesFromFixups(dia_session.get()))
+  // Next we parse out section contributions. Some of these may coincide with
+  // existing PE parsed blocks, but when they do we expect them to be exact
+  // collisions.
+  if (!CreateBlocksFromSectionContribs(session))
     return false;
 
-  // Disassemble code blocks and use the results to infer case and jump tables.
-  if (!DisassembleCodeBlocksAndLabelData())
+  // Flesh out the rest of the image with gap blocks.
+  if (!CreateGapBlocks())
     return false;
 
-  // Annotate the block-graph with symbol information.
-  if (parse_debug_info_ && !ProcessSymbols(global.get()))
+  // Finalize the PE-parsed intermediate references.
+  if (!FinalizeIntermediateReferences(references))
     return false;
 
   return true;
@@ -1331,76 +1470,64 @@ bool NewDecomposer::CreateBlocksFromCoffGroups() {
 }
 
 bool NewDecomposer::CreateBlocksFromSectionContribs(IDiaSession* session) {
-  ScopedComPtr<IDiaEnumSectionContribs> section_contribs;
-  SearchResult search_result = FindDiaTable(session,
-                                            section_contribs.Receive());
-  if (search_result != kSearchSucceeded) {
-    if (search_result == kSearchFailed)
-      LOG(ERROR) << "No section contribution table found.";
+  // The section contributions are read straight from the Dbi stream as a
+  // flat array, which is much faster than enumerating them via DIA.
+  pdb::PdbFile pdb_file;
+  pdb::PdbReader pdb_reader;
+  if (!pdb_reader.Read(pdb_path_, &pdb_file)) {
+    LOG(ERROR) << "Failed to load PDB: " << pdb_path_.value();
     return false;
   }
 
-  size_t rsrc_id = image_file_.GetSectionIndex(kResourceSectionName);
+  pdb::DbiStream dbi_stream;
+  scoped_refptr<pdb::PdbStream> dbi = pdb_file.GetStream(pdb::kDbiStream);
+  if (dbi.get() == NULL || !dbi_stream.Read(dbi.get())) {
+    LOG(ERROR) << "Failed to read the Dbi stream.";
+    return false;
+  }
 
-  LONG count = 0;
-  if (section_contribs->get_Count(&count) != S_OK) {
-    LOG(ERROR) << "Failed to get section contributions enumeration length.";
+  std::vector<pdb::ImageSectionContrib> section_contribs;
+  if (!pdb::ReadSectionContribsFromPdbFile(pdb_file, dbi_stream,
+                                           &section_contribs)) {
     return false;
   }
 
-  for (LONG visited = 0; visited < count; ++visited) {
-    ScopedComPtr<IDiaSectionContrib> section_contrib;
-    ULONG fetched = 0;
-    HRESULT hr = section_contribs->Next(1, section_contrib.Receive(), &fetched);
-    // The standard way to end an enumeration (according to the docs) is by
-    // returning S_FALSE and setting fetched to 0. We don't actually see this,
-    // but it wouldn't be an error if we did.
-    if (hr == S_FALSE && fetched == 0)
-      break;
-    if (hr != S_OK) {
-      LOG(ERROR) << "Failed to get DIA section contribution: "
-                 << com::LogHr(hr) << ".";
-      return false;
-    }
-    // We actually end up seeing S_OK and fetched == 0 when the enumeration
-    // terminates, which goes against the publishes documentations.
-    if (fetched == 0)
-      break;
+  // DIA is now only used to look at the compiler of each compiland.
+  CompilandSupportMap compiland_support;
+  if (!GetCompilandSupport(session, &compiland_support))
+    return false;
 
-    DWORD rva = 0;
-    DWORD length = 0;
-    DWORD section_id = 0;
-    BOOL code = FALSE;
-    ScopedComPtr<IDiaSymbol> compiland;
-    ScopedBstr bstr_name;
-    if ((hr = section_contrib->get_relativeVirtualAddress(&rva)) != S_OK ||
-        (hr = section_contrib->get_length(&length)) != S_OK ||
-        (hr = section_contrib->get_addressSection(&section_id)) != S_OK ||
-        (hr = section_contrib->get_code(&code)) != S_OK ||
-        (hr = section_contrib->get_compiland(compiland.Receive())) != S_OK ||
-        (hr = compiland->get_name(bstr_name.Receive())) != S_OK) {
-      LOG(ERROR) << "Failed to get section contribution properties: "
-                 << com::LogHr(hr) << ".";
+  // We don't parse the resource section, as it is parsed by the PEFileParser.
+  RelativeAddress rsrc_start;
+  RelativeAddress rsrc_end;
+  size_t rsrc_id = image_file_.GetSectionIndex(kResourceSectionName);
+  if (rsrc_id != kInvalidSection) {
+    const IMAGE_SECTION_HEADER* rsrc = image_file_.section_header(rsrc_id);
+    rsrc_start = RelativeAddress(rsrc->VirtualAddress);
+    rsrc_end = rsrc_start + rsrc->Misc.VirtualSize;
+  }
+
+  const pdb::DbiStream::DbiModuleVector& modules = dbi_stream.modules();
+  for (size_t i = 0; i < section_contribs.size(); ++i) {
+    const pdb::ImageSectionContrib& section_contrib = section_contribs[i];
+    RelativeAddress rva = section_contrib.rva;
+    size_t length = section_contrib.length;
+    if (rva >= rsrc_start && rva < rsrc_end)
+      continue;
+
+    if (section_contrib.module >= modules.size()) {
+      LOG(ERROR) << "Section contribution refers to invalid module "
+                 << section_contrib.module << ".";
       return false;
     }
+    const std::string& name = modules[section_contrib.module].module_name();
 
     // Determine if this function was built by a supported compiler.
+    CompilandSupportMap::const_iterator support_it =
+        compiland_support.find(name);
     bool is_built_by_supported_compiler =
-        IsBuiltBySupportedCompiler(compiland.get());
-
-    // DIA numbers sections from 1 to n, while we do 0 to n - 1.
-    DCHECK_LT(0u, section_id);
-    --section_id;
-
-    // We don't parse the resource section, as it is parsed by the PEFileParser.
-    if (section_id == rsrc_id)
-      continue;
-
-    std::string name;
-    if (!WideToUTF8(bstr_name, bstr_name.Length(), &name)) {
-      LOG(ERROR) << "Failed to convert compiland name to UTF8.";
-      return false;
-    }
+        support_it != compiland_support.end() && support_it->second;
+    bool code = (section_contrib.characteristics & IMAGE_SCN_CNT_CODE) != 0;
 
     // TODO(chrisha): We see special section contributions with the name
     //     "* CIL *". These are concatenations of data symbols and can very
@@ -1411,7 +1538,7 @@ bool NewDecomposer::CreateBlocksFromSectionContribs(IDiaSession* session) {
     BlockType block_type =
         code ? BlockGraph::CODE_BLOCK : BlockGraph::DATA_BLOCK;
     Block* block = CreateBlockOrFindCoveringPeBlock(
-        block_type, RelativeAddress(rva), length, name);
+        block_type, rva, length, name);
     if (block == NULL) {
       LOG(ERROR) << "Unable to create block for compiland \"" << name << "\".";
       return false;
@@ -1518,27 +1645,20 @@ bool NewDecomposer::DisassembleCodeBlocksAndLabelData() {
   return true;
 }
 
-bool NewDecomposer::CreateReferencesFromFixups(IDiaSession* session) {
-  DCHECK(session != NULL);
-
-  PEFile::RelocSet reloc_set;
-  if (!image_file_.DecodeRelocs(&reloc_set))
-    return false;
-
-  OMAPs omap_from;
-  PdbFixups fixups;
-  if (!LoadDebugStreams(session, &fixups, &omap_from))
-    return false;
+bool NewDecomposer::CreateReferencesFromFixups(FixupData* fixup_data) {
+  DCHECK(fixup_data != NULL);
+  DCHECK(fixup_data->loaded);
 
   // While creating references from the fixups this removes the
   // corresponding reference data from the relocs. We use this as a kind of
   // double-entry bookkeeping to ensure all is well and right in the world.
-  if (!CreateReferencesFromFixupsImpl(image_file_, fixups, omap_from,
-                                      &reloc_set, image_)) {
+  if (!CreateReferencesFromFixupsImpl(image_file_, fixup_data->fixups,
+                                      fixup_data->omap_from,
+                                      &fixup_data->reloc_set, image_)) {
     return false;
   }
 
-  if (!reloc_set.empty()) {
+  if (!fixup_data->reloc_set.empty()) {
     LOG(ERROR) << "Found reloc entries without matching FIXUP entries.";
     return false;
   }
@@ -1565,7 +1685,10 @@ bool NewDecomposer::ProcessSymbols(IDiaSymbol* root) {
   DiaBrowser::MatchCallback on_label_symbol(
       base::Bind(&NewDecomposer::OnLabelSymbol, base::Unretained(this)));
 
+  // Functions are reached both directly and via their compilands, and several
+  // tags are searched for beneath each of them, so memoize their children.
   DiaBrowser dia_browser;
+  dia_browser.set_memoize_children(true);
 
   // Find thunks.
   dia_browser.AddPattern(Seq(Opt(SymTagCompiland), SymTagThunk),
@@ -110,10 +110,25 @@ class NewDecomposer {
                                     bool* stream_exists);
   // @}
 
+  // Fixup related data that is loaded in parallel with block creation.
+  struct FixupData;
+
   // @name Decomposition steps, in order.
   // @{
   // Performs the actual decomposition.
   bool DecomposeImpl();
+  // Loads the FIXUP and OMAP_FROM streams from the PDB and decodes the image
+  // relocs. This runs on a worker thread while the blocks are created, and
+  // sets FixupData::loaded on success.
+  // @param image_file the image being decomposed.
+  // @param pdb_path the path of the PDB matching @p image_file.
+  // @param fixup_data receives the loaded data.
+  static void LoadFixupData(const PEFile& image_file,
+                            const base::FilePath& pdb_path,
+                            FixupData* fixup_data);
+  // Creates the sections and all of the blocks in the image, using the
+  // steps below.
+  bool CreateBlocks(IDiaSession* session);
   // Parses PE-related blocks and references.
   bool CreatePEImageBlocksAndReferences(IntermediateReferences* references);
   // Creates blocks from the COFF group symbols in the linker symbol stream.
@@ -125,8 +140,9 @@ class NewDecomposer {
   bool CreateGapBlocks();
   // Finalizes the given vector of intermediate references.
   bool FinalizeIntermediateReferences(const IntermediateReferences& references);
-  // Creates inter-block references from fixups.
-  bool CreateReferencesFromFixups(IDiaSession* session);
+  // Creates inter-block references from fixups. This consumes the relocs in
+  // @p fixup_data.
+  bool CreateReferencesFromFixups(FixupData* fixup_data);
   // Disassembles code blocks and labels jump and case tables.
   bool DisassembleCodeBlocksAndLabelData();
   // Processes symbols from the PDB, setting block names and labels. This
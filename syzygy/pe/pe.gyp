@@ -59,6 +59,8 @@
       'sources': [
         'block_util.cc',
         'block_util.h',
+        'coff_batch_relinker.cc',
+        'coff_batch_relinker.h',
         'coff_decomposer.cc',
         'coff_decomposer.h',
         'coff_file.cc',
@@ -78,6 +80,8 @@
         'dia_util_internal.h',
         'decomposer.cc',
         'decomposer.h',
+        'decomposition_cache.cc',
+        'decomposition_cache.h',
         'dos_stub.asm',
         'dos_stub.cc',
         'dos_stub.h',
@@ -131,6 +135,7 @@
         '<(src)/syzygy/block_graph/transforms/block_graph_transforms.gyp:'
             'block_graph_transforms_lib',
         '<(src)/syzygy/common/common.gyp:common_lib',
+        '<(src)/syzygy/common/common.gyp:stage_profiler_lib',
         '<(src)/syzygy/core/core.gyp:core_lib',
         '<(src)/syzygy/pdb/pdb.gyp:pdb_lib',
         '<(src)/third_party/distorm/distorm.gyp:distorm',
@@ -185,6 +190,7 @@
       'type': 'executable',
       'sources': [
         'block_util_unittest.cc',
+        'coff_batch_relinker_unittest.cc',
         'coff_decomposer_unittest.cc',
         'coff_file_unittest.cc',
         'coff_file_writer_unittest.cc',
@@ -194,6 +200,7 @@
         'decompose_app_unittest.cc',
         'decompose_image_to_text_unittest.cc',
         'decomposer_unittest.cc',
+        'decomposition_cache_unittest.cc',
         'dia_browser_unittest.cc',
         'dia_util_unittest.cc',
         'find_unittest.cc',
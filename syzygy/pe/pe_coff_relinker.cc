@@ -14,7 +14,9 @@
 
 #include "syzygy/pe/pe_coff_relinker.h"
 
+#include "base/stringprintf.h"
 #include "syzygy/block_graph/orderers/original_orderer.h"
+#include "syzygy/common/stage_profiler.h"
 
 namespace pe {
 namespace {
@@ -45,6 +47,8 @@ bool ApplyTransformsToBlockGraph(const std::vector<Transform*>& transforms,
 
   for (size_t i = 0; i < transforms.size(); ++i) {
     LOG(INFO) << "Applying transform: " << transforms[i]->name() << ".";
+    common::ScopedStageTimer timer(
+        base::StringPrintf("transform: %s", transforms[i]->name()));
     if (!ApplyBlockGraphTransform(
         transforms[i], policy, block_graph, headers_block)) {
       return false;
@@ -71,6 +75,8 @@ bool ApplyOrderersToBlockGraph(const std::vector<Orderer*>& orderers,
     DCHECK(orderer != NULL);
 
     LOG(INFO) << "Applying orderer: " << orderer->name();
+    common::ScopedStageTimer timer(
+        base::StringPrintf("orderer: %s", orderer->name()));
     if (!orderer->OrderBlockGraph(ordered_graph, headers_block)) {
       LOG(ERROR) << "Orderer failed: " << orderer->name() << ".";
       return false;
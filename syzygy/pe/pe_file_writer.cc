@@ -18,11 +18,15 @@
 #include <winnt.h>
 #include <imagehlp.h>  // NOLINT
 
+#include "base/bind.h"
 #include "base/file_util.h"
 #include "base/logging.h"
+#include "base/memory/scoped_vector.h"
+#include "base/threading/simple_thread.h"
 #include "base/win/scoped_handle.h"
 #include "sawbuck/common/buffer_parser.h"
 #include "sawbuck/common/com_utils.h"
+#include "syzygy/core/closure_delegate.h"
 #include "syzygy/pe/pe_utils.h"
 
 namespace pe {
@@ -36,8 +40,8 @@ using pe::ImageLayout;
 namespace {
 
 template <class Type>
-bool UpdateReference(size_t start, Type new_value, std::vector<uint8>* data) {
-  BinaryBufferParser parser(&data->at(0), data->size());
+bool UpdateReference(size_t start, Type new_value, uint8* data, size_t size) {
+  BinaryBufferParser parser(data, size);
 
   Type* ref_ptr = NULL;
   if (!parser.GetAt(start, const_cast<const Type**>(&ref_ptr))) {
@@ -105,13 +109,48 @@ size_t GetSectionOffset(const ImageLayout& image_layout,
   return rel_addr - section_info.addr;
 }
 
+// Calculates the checksum of a mapped image and writes it to its header.
+bool UpdateMappedImageChecksum(void* image_ptr, size_t file_size) {
+  DCHECK(image_ptr != NULL);
+
+  DWORD original_checksum = 0;
+  DWORD new_checksum = 0;
+  IMAGE_NT_HEADERS* nt_headers = ::CheckSumMappedFile(image_ptr,
+                                                      file_size,
+                                                      &original_checksum,
+                                                      &new_checksum);
+
+  if (nt_headers == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "CheckSumMappedFile failed: " << com::LogWe(error);
+    return false;
+  }
+
+  // On success, we write the checksum back to the file header.
+  nt_headers->OptionalHeader.CheckSum = new_checksum;
+  return true;
+}
+
 }  // namespace
 
 PEFileWriter::PEFileWriter(const ImageLayout& image_layout)
-    : image_layout_(image_layout), nt_headers_(NULL) {
+    : image_layout_(image_layout),
+      nt_headers_(NULL),
+      mapped_output_(false),
+      write_threads_(1) {
 }
 
 bool PEFileWriter::WriteImage(const base::FilePath& path) {
+  if (mapped_output_) {
+    if (!ValidateHeaders())
+      return false;
+    DCHECK(nt_headers_ != NULL);
+
+    bool success = CalculateSectionRanges() && WriteMappedImage(path);
+    nt_headers_ = NULL;
+    return success;
+  }
+
   // Start by attempting to open the destination file.
   file_util::ScopedFILE file(file_util::OpenFile(path, "wb"));
   if (file.get() == NULL) {
@@ -176,25 +215,10 @@ bool PEFileWriter::UpdateFileChecksum(const base::FilePath& path) {
   }
 
   // Calculate the image checksum.
-  DWORD original_checksum = 0;
-  DWORD new_checksum = 0;
-  IMAGE_NT_HEADERS* nt_headers = ::CheckSumMappedFile(image_ptr,
-                                                      file_size,
-                                                      &original_checksum,
-                                                      &new_checksum);
-
-  if (nt_headers == NULL) {
-    DWORD error = ::GetLastError();
-    LOG(ERROR) << "CheckSumMappedFile failed: " << com::LogWe(error);
-  }
-
-  // On success, we write the checksum back to the file header.
-  if (nt_headers != NULL) {
-    nt_headers->OptionalHeader.CheckSum = new_checksum;
-  }
+  bool success = UpdateMappedImageChecksum(image_ptr, file_size);
   CHECK(::UnmapViewOfFile(image_ptr));
 
-  return nt_headers != NULL;
+  return success;
 }
 
 bool PEFileWriter::ValidateHeaders() {
@@ -326,86 +350,213 @@ bool PEFileWriter::CalculateSectionRanges() {
 bool PEFileWriter::WriteBlocks(FILE* file) {
   DCHECK(file != NULL);
 
-  AbsoluteAddress image_base(nt_headers_->OptionalHeader.ImageBase);
+  // Assemble the whole image in a buffer.
+  size_t image_size = GetImageFileSize();
+  std::vector<uint8> buffer(image_size);
+  if (!WriteImageData(&buffer[0], buffer.size()))
+    return false;
+
+  // Write the whole image to disk in one go.
+  if (::fwrite(&buffer[0], sizeof(buffer[0]), buffer.size(), file) !=
+          buffer.size()) {
+    LOG(ERROR) << "Failed to write image to file.";
+    return false;
+  }
+
+  return true;
+}
+
+bool PEFileWriter::WriteMappedImage(const base::FilePath& path) {
+  DCHECK(nt_headers_ != NULL);
+
+  size_t image_size = GetImageFileSize();
+
+  // Create the destination file and give it its final size.
+  base::win::ScopedHandle image_handle(
+      ::CreateFile(path.value().c_str(), GENERIC_READ | GENERIC_WRITE, 0,
+                   NULL, CREATE_ALWAYS, 0, NULL));
+  if (!image_handle.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to create " << path.value() << ": "
+               << com::LogWe(error);
+    return false;
+  }
 
-  // Create the output buffer, reserving enough room for the whole file.
+  if (::SetFilePointer(image_handle.Get(), image_size, NULL, FILE_BEGIN) ==
+          INVALID_SET_FILE_POINTER ||
+      !::SetEndOfFile(image_handle.Get())) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to resize " << path.value() << ": "
+               << com::LogWe(error);
+    return false;
+  }
+
+  // Map the entire file read/write to memory.
+  base::win::ScopedHandle image_mapping(::CreateFileMapping(image_handle.Get(),
+                                                            NULL,
+                                                            PAGE_READWRITE,
+                                                            0,
+                                                            0,
+                                                            NULL));
+  void* image_ptr = NULL;
+  if (image_mapping.IsValid()) {
+    image_ptr = ::MapViewOfFile(image_mapping.Get(),
+                                FILE_MAP_WRITE,
+                                0,
+                                0,
+                                image_size);
+  }
+
+  if (image_ptr == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to create image mapping: " << com::LogWe(error);
+    return false;
+  }
+
+  // Write the blocks directly into place, then checksum the image while it's
+  // still mapped.
+  uint8* image = reinterpret_cast<uint8*>(image_ptr);
+  bool success = WriteImageData(image, image_size) &&
+      UpdateMappedImageChecksum(image_ptr, image_size);
+  CHECK(::UnmapViewOfFile(image_ptr));
+
+  return success;
+}
+
+size_t PEFileWriter::GetImageFileSize() const {
   DCHECK(!image_layout_.sections.empty());
   size_t last_section_index = image_layout_.sections.size() - 1;
-  size_t image_size = section_file_range_map_[last_section_index].end().value();
-  std::vector<uint8> buffer;
-  buffer.reserve(image_size);
+  return GetSectionFileRange(last_section_index).end().value();
+}
+
+bool PEFileWriter::WriteImageData(uint8* image, size_t image_size) {
+  DCHECK(image != NULL);
+  DCHECK_EQ(GetImageFileSize(), image_size);
 
-  // Iterate through all blocks in the address space writing them as we go.
-  BlockGraph::AddressSpace::RangeMap::const_iterator block_it(
+  // Iterate through all blocks in the address space, splitting them into the
+  // header and the sections. Note that the section index is not the same
+  // thing as the section_id stored in the block; the section IDs are relative
+  // to the section data stored in the block-graph, not the ordered section
+  // infos stored in the image layout.
+  BlockGraph::AddressSpace::RangeMapConstIter block_it(
       image_layout_.blocks.address_space_impl().ranges().begin());
-  BlockGraph::AddressSpace::RangeMap::const_iterator block_end(
+  BlockGraph::AddressSpace::RangeMapConstIter block_end(
       image_layout_.blocks.address_space_impl().ranges().end());
 
-  // Write all of the blocks. We take care of writing the padding at the
-  // end of each section. Note that the section index is not the same thing as
-  // the section_id stored in the block; the section IDs are relative to the
-  // section data stored in the block-graph, not the ordered section infos
-  // stored in the image layout.
+  std::vector<SectionBlocks> sections;
+  SectionBlocks header = { BlockGraph::kInvalidSectionId, block_it, block_it };
+  sections.push_back(header);
   BlockGraph::SectionId section_id = BlockGraph::kInvalidSectionId;
-  size_t section_index = BlockGraph::kInvalidSectionId;
   for (; block_it != block_end; ++block_it) {
-    BlockGraph::Block* block = const_cast<BlockGraph::Block*>(block_it->second);
-
-    // If we're jumping to a new section output the necessary padding.
-    if (block->section() != section_id) {
-      FlushSection(section_index, &buffer);
-      section_id = block->section();
-      section_index++;
-      DCHECK_GT(image_layout_.sections.size(), section_index);
+    // If we're jumping to a new section start a new range of blocks.
+    if (block_it->second->section() != section_id) {
+      sections.back().end = block_it;
+      section_id = block_it->second->section();
+      SectionBlocks section = { sections.size() - 1, block_it, block_it };
+      DCHECK_GT(image_layout_.sections.size(), section.section_index);
+      sections.push_back(section);
     }
+  }
+  sections.back().end = block_end;
 
-    if (!WriteOneBlock(image_base, section_index, block, &buffer)) {
-      LOG(ERROR) << "Failed to write block \"" << block->name() << "\".";
-      return false;
-    }
+  // Sections without any blocks still need to be padded.
+  while (sections.size() <= image_layout_.sections.size()) {
+    SectionBlocks section = { sections.size() - 1, block_end, block_end };
+    sections.push_back(section);
   }
 
-  FlushSection(last_section_index, &buffer);
-  DCHECK_EQ(image_size, buffer.size());
+  // Write the sections. Each of them only touches its own range of the image,
+  // and the image layout and section ranges are only ever read.
+  scoped_ptr<bool[]> results(new bool[sections.size()]);
+  if (write_threads_ <= 1 || sections.size() <= 1) {
+    for (size_t i = 0; i < sections.size(); ++i) {
+      WriteSection(&sections[i], image, image_size, &results[i]);
+      if (!results[i])
+        return false;
+    }
+  } else {
+    ScopedVector<core::ClosureDelegate> work;
+    for (size_t i = 0; i < sections.size(); ++i) {
+      work.push_back(new core::ClosureDelegate(
+          base::Bind(&PEFileWriter::WriteSection, base::Unretained(this),
+                     &sections[i], image, image_size, &results[i])));
+    }
 
-  // Write the whole image to disk in one go.
-  if (::fwrite(&buffer[0], sizeof(buffer[0]), buffer.size(), file) !=
-          buffer.size()) {
-    LOG(ERROR) << "Failed to write image to file.";
-    return false;
+    base::DelegateSimpleThreadPool pool("PEFileWriter",
+                                        static_cast<int>(write_threads_));
+    pool.Start();
+    for (size_t i = 0; i < work.size(); ++i)
+      pool.AddWork(work[i]);
+    pool.JoinAll();
+  }
+
+  for (size_t i = 0; i < sections.size(); ++i) {
+    if (!results[i])
+      return false;
   }
 
   return true;
 }
 
-void PEFileWriter::FlushSection(size_t section_index,
-                                std::vector<uint8>* buffer) {
-  DCHECK(buffer != NULL);
-
-  size_t section_file_end =
-      section_file_range_map_[section_index].end().value();
+void PEFileWriter::WriteSection(const SectionBlocks* section,
+                                uint8* image,
+                                size_t image_size,
+                                bool* success) {
+  DCHECK(section != NULL);
+  DCHECK(image != NULL);
+  DCHECK(success != NULL);
+
+  *success = false;
+
+  // Pad the whole section, starting at the end of the previous one. The
+  // blocks are then written over the padding.
+  const FileRange& file_range = GetSectionFileRange(section->section_index);
+  size_t fill_start = 0;
+  if (section->section_index != BlockGraph::kInvalidSectionId) {
+    size_t previous_index = section->section_index - 1;
+    if (section->section_index == 0)
+      previous_index = BlockGraph::kInvalidSectionId;
+    fill_start = GetSectionFileRange(previous_index).end().value();
+  }
+  size_t fill_end = file_range.end().value();
+  DCHECK_LE(fill_start, fill_end);
+  DCHECK_LE(fill_end, image_size);
+  ::memset(image + fill_start,
+           GetSectionPaddingByte(image_layout_, section->section_index),
+           fill_end - fill_start);
 
-  // We've already sanity checked this in CalculateSectionFileRanges, so this
-  // should be true.
-  DCHECK_GE(section_file_end, buffer->size());
-  if (section_file_end == buffer->size())
-    return;
+  AbsoluteAddress image_base(nt_headers_->OptionalHeader.ImageBase);
+  BlockGraph::AddressSpace::RangeMapConstIter block_it = section->begin;
+  for (; block_it != section->end; ++block_it) {
+    const BlockGraph::Block* block = block_it->second;
+    if (!WriteOneBlock(image_base, section->section_index, block, image,
+                       image_size)) {
+      LOG(ERROR) << "Failed to write block \"" << block->name() << "\".";
+      return;
+    }
+  }
 
-  uint8 padding_byte = GetSectionPaddingByte(image_layout_, section_index);
-  buffer->resize(section_file_end, padding_byte);
+  *success = true;
+}
 
-  return;
+const PEFileWriter::FileRange& PEFileWriter::GetSectionFileRange(
+    size_t section_index) const {
+  SectionIndexFileRangeMap::const_iterator it =
+      section_file_range_map_.find(section_index);
+  DCHECK(it != section_file_range_map_.end());
+  return it->second;
 }
 
 bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
                                  size_t section_index,
                                  const BlockGraph::Block* block,
-                                 std::vector<uint8>* buffer) {
+                                 uint8* image,
+                                 size_t image_size) {
   // This function walks through the data referred by the input block, and
   // patches it to reflect the addresses and offsets of the blocks
   // referenced before writing the block's data to the file.
   DCHECK(block != NULL);
-  DCHECK(buffer != NULL);
+  DCHECK(image != NULL);
 
   RelativeAddress addr;
   if (!image_layout_.blocks.GetAddressOf(block, &addr)) {
@@ -413,11 +564,9 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     return false;
   }
 
-  // Get the start address of the section containing this block as well as the
-  // padding byte we need to use.
+  // Get the start address of the section containing this block.
   RelativeAddress section_start(0);
   RelativeAddress section_end(image_layout_.sections[0].addr);
-  uint8 padding_byte = GetSectionPaddingByte(image_layout_, section_index);
   if (section_index != BlockGraph::kInvalidSectionId) {
     const ImageLayout::SectionInfo& section_info =
         image_layout_.sections[section_index];
@@ -425,7 +574,7 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     section_end = section_start + section_info.size;
   }
 
-  const FileRange& section_file_range = section_file_range_map_[section_index];
+  const FileRange& section_file_range = GetSectionFileRange(section_index);
 
   // The block should lie entirely within the section.
   if (addr < section_start || addr + block->size() > section_end) {
@@ -438,11 +587,6 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
   BlockGraph::Offset section_offs = addr - section_start;
   FileOffsetAddress file_offs = section_file_range.start() + section_offs;
 
-  // We shouldn't have written anything to the spot where the block belongs.
-  // This is only a DCHECK because the address space of the image layout and
-  // the consistency of the sections guarantees this for us.
-  DCHECK_LE(buffer->size(), file_offs.value());
-
   size_t inited_data_size = GetBlockInitializedDataSize(block);
 
   // If this block is entirely in the virtual portion of the section, skip it.
@@ -464,14 +608,12 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     return false;
   }
 
-  // Add any necessary padding to get us to the block offset.
-  if (buffer->size() < file_offs.value())
-    buffer->resize(file_offs.value(), padding_byte);
-
-  // Copy the block data into the buffer.
-  buffer->insert(buffer->end(),
-                 block->data(),
-                 block->data() + block->data_size());
+  // Copy the block data into place. The padding preceding it has already
+  // been written.
+  DCHECK_LE(section_file_range.end().value(), image_size);
+  uint8* block_data = image + file_offs.value();
+  if (block->data_size() != 0)
+    ::memcpy(block_data, block->data(), block->data_size());
 
   // We now want to append zeros for the implicit portion of the block data.
   size_t trailing_zeros = block->size() - block->data_size();
@@ -490,7 +632,7 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     }
 
     // Write the implicit trailing zeros.
-    buffer->insert(buffer->end(), trailing_zeros, 0);
+    ::memset(block_data + block->data_size(), 0, trailing_zeros);
   }
 
   // Patch up all the references.
@@ -537,8 +679,7 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
         // Get the offset of the block in its section, as well as the range of
         // the section on disk. Validate that the referred location is
         // actually directly represented on disk (not in implicit virtual data).
-        const FileRange& file_range =
-            section_file_range_map_[dst_section_index];
+        const FileRange& file_range = GetSectionFileRange(dst_section_index);
         size_t section_offset = GetSectionOffset(image_layout_,
                                                  dst_addr,
                                                  dst_section_index);
@@ -562,18 +703,24 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     BlockGraph::Offset ref_offset = file_offs.value() + start;
     switch (ref.size()) {
       case sizeof(uint8):
-        if (!UpdateReference(ref_offset, static_cast<uint8>(value), buffer))
+        if (!UpdateReference(ref_offset, static_cast<uint8>(value), image,
+                             image_size)) {
           return false;
+        }
         break;
 
       case sizeof(uint16):
-        if (!UpdateReference(ref_offset, static_cast<uint16>(value), buffer))
+        if (!UpdateReference(ref_offset, static_cast<uint16>(value), image,
+                             image_size)) {
           return false;
+        }
         break;
 
       case sizeof(uint32):
-        if (!UpdateReference(ref_offset, static_cast<uint32>(value), buffer))
+        if (!UpdateReference(ref_offset, static_cast<uint32>(value), image,
+                             image_size)) {
           return false;
+        }
         break;
 
       default:
@@ -15,9 +15,13 @@
 #ifndef SYZYGY_PE_PE_FILE_WRITER_H_
 #define SYZYGY_PE_PE_FILE_WRITER_H_
 
+#include <map>
+#include <vector>
+
 #include "base/files/file_path.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/core/address_space.h"
+#include "syzygy/core/flat_map.h"
 #include "syzygy/pe/decomposer.h"
 #include "syzygy/pe/image_layout.h"
 #include "syzygy/pe/pe_file_parser.h"
@@ -39,6 +43,31 @@ class PEFileWriter {
   // Writes the image to path.
   bool WriteImage(const base::FilePath& path);
 
+  // Sets whether the image is written through a mapping of the output file.
+  // When enabled the output file is pre-sized and mapped, the blocks are
+  // copied directly into place and the checksum is updated in the same
+  // mapping, rather than assembling the image in a buffer, writing it out and
+  // mapping the file a second time to checksum it. Defaults to false.
+  // @param mapped_output true to write the image through a mapping.
+  void set_mapped_output(bool mapped_output) { mapped_output_ = mapped_output; }
+
+  // @returns true if the image is written through a mapping of the output
+  //     file.
+  bool mapped_output() const { return mapped_output_; }
+
+  // Sets the number of worker threads used to write the sections of the
+  // image. Each section occupies its own range of the output, so they can be
+  // written independently. A value of 1 writes them on the calling thread.
+  // Defaults to 1.
+  // @param write_threads the number of worker threads to use.
+  void set_write_threads(size_t write_threads) {
+    DCHECK_LT(0u, write_threads);
+    write_threads_ = write_threads;
+  }
+
+  // @returns the number of worker threads used to write the sections.
+  size_t write_threads() const { return write_threads_; }
+
   // Updates the checksum for the image @p path.
   static bool UpdateFileChecksum(const base::FilePath& path);
 
@@ -51,22 +80,55 @@ class PEFileWriter {
   // section_file_range_map_ and section_index_space_.
   bool CalculateSectionRanges();
 
-  // Writes the entire image to the given file. Delegates to FlushSection and
-  // WriteOneBlock.
-  bool WriteBlocks(FILE* file);
+  // The blocks of the header or of a section, as a range of the address
+  // space of the image layout.
+  struct SectionBlocks {
+    // The index of the section, or kInvalidSectionId for the header.
+    size_t section_index;
+    BlockGraph::AddressSpace::RangeMapConstIter begin;
+    BlockGraph::AddressSpace::RangeMapConstIter end;
+  };
 
-  // Closes off the writing of a section by adding any necessary padding to the
-  // output buffer.
-  void FlushSection(size_t section_index,
-                    std::vector<uint8>* buffer);
+  // Writes the entire image to the given file. Delegates to WriteImageData.
+  bool WriteBlocks(FILE* file);
 
-  // Writes a single block to the buffer, first writing any necessary padding
-  // (the content of which depends on the section type), followed by the
-  // block data (containing finalized references).
+  // Writes the entire image to a new file through a mapping of that file, and
+  // updates its checksum. The headers must have been validated and the section
+  // ranges calculated. Delegates to WriteImageData.
+  bool WriteMappedImage(const base::FilePath& path);
+
+  // @returns the size of the image on disk.
+  size_t GetImageFileSize() const;
+
+  // Writes the entire image to a buffer, one section at a time, possibly on
+  // several threads. Delegates to WriteSection.
+  // @param image the buffer receiving the image.
+  // @param image_size the size of @p image, as returned by GetImageFileSize.
+  // @returns true on success, false otherwise.
+  bool WriteImageData(uint8* image, size_t image_size);
+
+  // Writes the header or a section to the image buffer: fills its range of the
+  // buffer (along with any gap preceding it) with the padding byte of the
+  // section, then writes its blocks in place. This only touches the range of
+  // the buffer belonging to the section.
+  // @param section the section to write.
+  // @param image the buffer receiving the image.
+  // @param image_size the size of @p image.
+  // @param success receives true on success, false otherwise.
+  void WriteSection(const SectionBlocks* section,
+                    uint8* image,
+                    size_t image_size,
+                    bool* success);
+
+  // Writes a single block to the image buffer at its file offset. This writes
+  // the block data (containing finalized references) followed by its implicit
+  // trailing zeros. The padding around the block is expected to be in place
+  // already.
   bool WriteOneBlock(AbsoluteAddress image_base,
                      size_t section_index,
                      const BlockGraph::Block* block,
-                     std::vector<uint8>* buffer);
+                     uint8* image,
+                     size_t image_size);
 
   // The file ranges of each section. This is populated by
   // CalculateSectionRanges and is a map from section index (as ordered in
@@ -75,11 +137,20 @@ class PEFileWriter {
   typedef std::map<size_t, FileRange> SectionIndexFileRangeMap;
   SectionIndexFileRangeMap section_file_range_map_;
 
+  // @returns the file range of a section, as populated by
+  //     CalculateSectionRanges. This is safe to call from several threads.
+  // @param section_index the index of the section, or kInvalidSectionId for
+  //     the header.
+  const FileRange& GetSectionFileRange(size_t section_index) const;
+
   // This stores an address-space from RVAs to section indices and is populated
   // by CalculateSectionRanges. This can be used to map from a block's
   // address to the index of its section. This is needed for finalizing
-  // references.
-  typedef core::AddressSpace<core::RelativeAddress, size_t, size_t>
+  // references. It is populated once, in order, and then searched for every
+  // reference in the image, so it uses the sorted array backend.
+  typedef core::AddressRange<core::RelativeAddress, size_t> SectionRange;
+  typedef core::AddressSpace<core::RelativeAddress, size_t, size_t,
+                             core::FlatMap<SectionRange, size_t> >
       SectionIndexSpace;
   SectionIndexSpace section_index_space_;
 
@@ -89,6 +160,12 @@ class PEFileWriter {
   // Refers to the nt headers from the image during WriteImage.
   const IMAGE_NT_HEADERS* nt_headers_;
 
+  // True if the image is written through a mapping of the output file.
+  bool mapped_output_;
+
+  // The number of worker threads used to write the sections.
+  size_t write_threads_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(PEFileWriter);
 };
@@ -66,6 +66,44 @@ TEST_F(PEFileWriterTest, RewriteAndLoadImage) {
   ASSERT_NO_FATAL_FAILURE(CheckTestDll(temp_file));
 }
 
+TEST_F(PEFileWriterTest, RewriteMappedImageOnSeveralThreads) {
+  base::FilePath temp_dir;
+  ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir));
+  base::FilePath buffered_dir = temp_dir.Append(L"buffered");
+  base::FilePath mapped_dir = temp_dir.Append(L"mapped");
+  ASSERT_TRUE(file_util::CreateDirectory(buffered_dir));
+  ASSERT_TRUE(file_util::CreateDirectory(mapped_dir));
+  base::FilePath buffered_file = buffered_dir.Append(testing::kTestDllName);
+  base::FilePath mapped_file = mapped_dir.Append(testing::kTestDllName);
+
+  // Decompose the original test image.
+  PEFile image_file;
+  base::FilePath image_path(testing::GetExeRelativePath(testing::kTestDllName));
+  ASSERT_TRUE(image_file.Init(image_path));
+
+  Decomposer decomposer(image_file);
+  block_graph::BlockGraph block_graph;
+  pe::ImageLayout image_layout(&block_graph);
+  ASSERT_TRUE(decomposer.Decompose(&image_layout));
+
+  PEFileWriter buffered_writer(image_layout);
+  ASSERT_TRUE(buffered_writer.WriteImage(buffered_file));
+
+  PEFileWriter mapped_writer(image_layout);
+  EXPECT_FALSE(mapped_writer.mapped_output());
+  EXPECT_EQ(1u, mapped_writer.write_threads());
+  mapped_writer.set_mapped_output(true);
+  mapped_writer.set_write_threads(4);
+  EXPECT_TRUE(mapped_writer.mapped_output());
+  EXPECT_EQ(4u, mapped_writer.write_threads());
+  ASSERT_TRUE(mapped_writer.WriteImage(mapped_file));
+  ASSERT_NO_FATAL_FAILURE(CheckTestDll(mapped_file));
+
+  // Both ways of writing the image must produce the same file, checksum
+  // included.
+  EXPECT_TRUE(file_util::ContentsEqual(buffered_file, mapped_file));
+}
+
 TEST_F(PEFileWriterTest, UpdateFileChecksum) {
   base::FilePath temp_dir;
   ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir));
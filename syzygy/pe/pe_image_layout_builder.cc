@@ -18,6 +18,8 @@
 #include <ctime>
 
 #include "base/string_util.h"
+#include "base/memory/scoped_vector.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/block_graph/typed_block.h"
 #include "syzygy/common/align.h"
 #include "syzygy/pe/pe_utils.h"
@@ -30,6 +32,7 @@ using block_graph::TypedBlock;
 using core::RelativeAddress;
 
 typedef std::vector<uint8> ByteVector;
+typedef BlockGraph::AddressSpace::RangeMap::const_iterator RangeMapConstIter;
 
 // A utility class to help with formatting the relocations section.
 class RelocWriter {
@@ -114,6 +117,47 @@ class RelocWriter {
   size_t curr_header_offset_;
 };
 
+// Collects the addresses of the absolute references in a contiguous run of
+// blocks of the address space. Each collector only reads the blocks it covers,
+// so several of them can run concurrently on disjoint runs.
+class RelocCollector : public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param begin the first block of the run.
+  // @param end one past the last block of the run.
+  RelocCollector(RangeMapConstIter begin, RangeMapConstIter end)
+      : begin_(begin), end_(end) {
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  virtual void Run() OVERRIDE {
+    // Blocks are visited in order of increasing address, and references in
+    // order of increasing offset, so the addresses come out sorted.
+    for (RangeMapConstIter it = begin_; it != end_; ++it) {
+      const BlockGraph::Block* block = it->second;
+      RelativeAddress block_addr = it->first.start();
+
+      BlockGraph::Block::ReferenceMap::const_iterator ref_it(
+          block->references().begin());
+      for (; ref_it != block->references().end(); ++ref_it) {
+        if (ref_it->second.type() == BlockGraph::ABSOLUTE_REF)
+          relocs_.push_back(block_addr + ref_it->first);
+      }
+    }
+  }
+  // @}
+
+  // @returns the addresses of the absolute references in the run.
+  const std::vector<RelativeAddress>& relocs() const { return relocs_; }
+
+ private:
+  RangeMapConstIter begin_;
+  RangeMapConstIter end_;
+  std::vector<RelativeAddress> relocs_;
+
+  DISALLOW_COPY_AND_ASSIGN(RelocCollector);
+};
+
 // Returns true iff ref is a valid reference in addr_space.
 bool IsValidReference(const BlockGraph::AddressSpace& addr_space,
                       const BlockGraph::Reference& ref) {
@@ -165,7 +209,8 @@ namespace pe {
 PEImageLayoutBuilder::PEImageLayoutBuilder(ImageLayout* image_layout)
     : PECoffImageLayoutBuilder(image_layout),
       dos_header_block_(NULL),
-      nt_headers_block_(NULL) {
+      nt_headers_block_(NULL),
+      num_threads_(1) {
 }
 
 bool PEImageLayoutBuilder::LayoutImageHeaders(
@@ -378,30 +423,42 @@ bool PEImageLayoutBuilder::CreateRelocsSection() {
   BlockGraph::Block* relocs_block = reloc_data.block();
   CHECK_EQ(0, reloc_data.offset());
 
-  // Iterate over all blocks in the address space, in the
-  // order of increasing addresses.
-  BlockGraph::AddressSpace::RangeMap::const_iterator it(
-      image_layout_->blocks.address_space_impl().ranges().begin());
-  BlockGraph::AddressSpace::RangeMap::const_iterator end(
-      image_layout_->blocks.address_space_impl().ranges().end());
-
-  for (; it != end; ++it) {
-    const BlockGraph::Block* block = it->second;
-    RelativeAddress block_addr;
-    CHECK(image_layout_->blocks.GetAddressOf(block, &block_addr));
-
-    // Iterate over all outgoing references in this block in
-    // order of increasing offset.
-    BlockGraph::Block::ReferenceMap::const_iterator ref_it(
-        block->references().begin());
-    BlockGraph::Block::ReferenceMap::const_iterator ref_end(
-        block->references().end());
-    for (; ref_it != ref_end; ++ref_it) {
-      // Add each absolute reference to the relocs.
-      if (ref_it->second.type() == BlockGraph::ABSOLUTE_REF) {
-        writer.WriteReloc(block_addr + ref_it->first);
-      }
-    }
+  // Split the blocks in the address space into one run per section, plus one
+  // for the headers that precede the first section.
+  const BlockGraph::AddressSpace::RangeMap& ranges =
+      image_layout_->blocks.address_space_impl().ranges();
+  ScopedVector<RelocCollector> collectors;
+  RangeMapConstIter run_begin(ranges.begin());
+  RangeMapConstIter it(ranges.begin());
+  for (size_t i = 0; i < image_layout_->sections.size(); ++i) {
+    RelativeAddress section_addr(image_layout_->sections[i].addr);
+    while (it != ranges.end() && it->first.start() < section_addr)
+      ++it;
+    collectors.push_back(new RelocCollector(run_begin, it));
+    run_begin = it;
+  }
+  collectors.push_back(new RelocCollector(run_begin, ranges.end()));
+
+  // Collect the relocations of each run.
+  if (num_threads_ > 1 && collectors.size() > 1) {
+    base::DelegateSimpleThreadPool pool(
+        "PEImageLayoutBuilder",
+        static_cast<int>(std::min(num_threads_, collectors.size())));
+    pool.Start();
+    for (size_t i = 0; i < collectors.size(); ++i)
+      pool.AddWork(collectors[i]);
+    pool.JoinAll();
+  } else {
+    for (size_t i = 0; i < collectors.size(); ++i)
+      collectors[i]->Run();
+  }
+
+  // The runs are in order of increasing address, so writing them one after
+  // the other produces the same page blocks as a single pass would.
+  for (size_t i = 0; i < collectors.size(); ++i) {
+    const std::vector<RelativeAddress>& relocs = collectors[i]->relocs();
+    for (size_t j = 0; j < relocs.size(); ++j)
+      writer.WriteReloc(relocs[j]);
   }
 
   // Get the relocations data from the writer.
@@ -48,6 +48,19 @@ class PEImageLayoutBuilder : public PECoffImageLayoutBuilder {
     return nt_headers_block_;
   }
 
+  // Sets the number of threads used to collect relocations while finalizing
+  // the image. The relocations are collected per section, so there's no
+  // benefit to using more threads than there are sections. The output does
+  // not depend on the number of threads.
+  // @param num_threads the number of threads to use. Must be at least 1.
+  void set_num_threads(size_t num_threads) {
+    DCHECK_LT(0u, num_threads);
+    num_threads_ = num_threads;
+  }
+
+  // @returns the number of threads used to collect relocations.
+  size_t num_threads() const { return num_threads_; }
+
   // Lays out the image headers, and sets the file and section alignment using
   // the values from the header.
   // @param dos_header_block must be a block that's a valid DOS header
@@ -94,6 +107,9 @@ class PEImageLayoutBuilder : public PECoffImageLayoutBuilder {
   BlockGraph::Block* dos_header_block_;
   BlockGraph::Block* nt_headers_block_;
 
+  // The number of threads used to collect relocations.
+  size_t num_threads_;
+
   DISALLOW_COPY_AND_ASSIGN(PEImageLayoutBuilder);
 };
 
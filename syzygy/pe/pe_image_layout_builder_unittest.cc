@@ -99,6 +99,7 @@ TEST_F(PEImageLayoutBuilderTest, Initialization) {
   EXPECT_EQ(NULL, builder.nt_headers_block());
   EXPECT_EQ(0, builder.padding());
   EXPECT_EQ(1, builder.code_alignment());
+  EXPECT_EQ(1u, builder.num_threads());
 }
 
 TEST_F(PEImageLayoutBuilderTest, Accessors) {
@@ -107,8 +108,10 @@ TEST_F(PEImageLayoutBuilderTest, Accessors) {
 
   builder.set_padding(16);
   builder.set_code_alignment(8);
+  builder.set_num_threads(4);
   EXPECT_EQ(16, builder.padding());
   EXPECT_EQ(8, builder.code_alignment());
+  EXPECT_EQ(4u, builder.num_threads());
 }
 
 TEST_F(PEImageLayoutBuilderTest, LayoutImageHeaders) {
@@ -149,6 +152,33 @@ TEST_F(PEImageLayoutBuilderTest, RewriteTestDll) {
   EXPECT_LE(rewritten_size, orig_size);
 }
 
+TEST_F(PEImageLayoutBuilderTest, RewriteTestDllConcurrently) {
+  OrderedBlockGraph obg(&block_graph_);
+  block_graph::orderers::OriginalOrderer orig_orderer;
+  ASSERT_TRUE(orig_orderer.OrderBlockGraph(&obg, dos_header_block_));
+
+  ImageLayout layout(&block_graph_);
+  PEImageLayoutBuilder builder(&layout);
+  builder.set_num_threads(4);
+  ASSERT_TRUE(builder.LayoutImageHeaders(dos_header_block_));
+  EXPECT_TRUE(builder.LayoutOrderedBlockGraph(obg));
+  EXPECT_TRUE(builder.Finalize());
+
+  PEFileWriter writer(layout);
+  ASSERT_TRUE(writer.WriteImage(temp_file_));
+  ASSERT_NO_FATAL_FAILURE(CheckTestDll(temp_file_));
+
+  // The blocks keep their addresses, so collecting the relocations per
+  // section produces the same relocations as the original image.
+  PEFile::RelocSet orig_relocs;
+  ASSERT_TRUE(image_file_.DecodeRelocs(&orig_relocs));
+  PEFile rewritten_file;
+  ASSERT_TRUE(rewritten_file.Init(temp_file_));
+  PEFile::RelocSet rewritten_relocs;
+  ASSERT_TRUE(rewritten_file.DecodeRelocs(&rewritten_relocs));
+  EXPECT_EQ(orig_relocs, rewritten_relocs);
+}
+
 TEST_F(PEImageLayoutBuilderTest, PadTestDll) {
   OrderedBlockGraph obg(&block_graph_);
   block_graph::orderers::OriginalOrderer orig_orderer;
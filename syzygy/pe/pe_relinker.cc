@@ -14,7 +14,12 @@
 
 #include "syzygy/pe/pe_relinker.h"
 
+#include "base/bind.h"
+#include "base/callback.h"
 #include "base/file_util.h"
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
+#include "syzygy/common/stage_profiler.h"
 #include "syzygy/core/zstream.h"
 #include "syzygy/pdb/pdb_byte_stream.h"
 #include "syzygy/pdb/pdb_file.h"
@@ -46,6 +51,7 @@ typedef block_graph::BlockGraphOrdererInterface Orderer;
 using block_graph::ApplyBlockGraphTransform;
 using block_graph::BlockGraph;
 using block_graph::OrderedBlockGraph;
+using common::ScopedStageTimer;
 using core::RelativeAddress;
 using pdb::NameStreamMap;
 using pdb::PdbByteStream;
@@ -260,6 +266,7 @@ bool ApplyPdbMutators(const std::vector<PdbMutatorInterface*>& pdb_mutators,
 // Lays out the image.
 bool BuildImageLayout(size_t padding,
                       size_t code_alignment,
+                      size_t num_threads,
                       const OrderedBlockGraph& ordered_block_graph,
                       BlockGraph::Block* dos_header_block,
                       ImageLayout* image_layout) {
@@ -271,6 +278,7 @@ bool BuildImageLayout(size_t padding,
   PEImageLayoutBuilder builder(image_layout);
   builder.set_padding(padding);
   builder.set_code_alignment(code_alignment);
+  builder.set_num_threads(num_threads);
   if (!builder.LayoutImageHeaders(dos_header_block)) {
     LOG(ERROR) << "PEImageLayoutBuilder::LayoutImageHeaders failed.";
     return false;
@@ -361,8 +369,13 @@ bool SetOmapAndGuid(const RelativeAddressRange input_range,
   return true;
 }
 
+// Writes a PDB file. If @p source_pdb_file is provided, only the streams that
+// differ from it are written, and the others are copied from
+// @p source_pdb_path.
 bool WritePdbFile(const base::FilePath& output_pdb_path,
-                  const PdbFile& pdb_file) {
+                  const PdbFile& pdb_file,
+                  const base::FilePath& source_pdb_path,
+                  const PdbFile* source_pdb_file) {
   LOG(INFO) << "Writing PDB file: " << output_pdb_path.value();
 
   base::FilePath temp_pdb;
@@ -373,7 +386,14 @@ bool WritePdbFile(const base::FilePath& output_pdb_path,
   }
 
   pdb::PdbWriter pdb_writer;
-  if (!pdb_writer.Write(temp_pdb, pdb_file)) {
+  bool written = false;
+  if (source_pdb_file != NULL) {
+    written = pdb_writer.WriteIncremental(temp_pdb, pdb_file, source_pdb_path,
+                                          *source_pdb_file);
+  } else {
+    written = pdb_writer.Write(temp_pdb, pdb_file);
+  }
+  if (!written) {
     LOG(ERROR) << "Failed to write temporary PDB file to \""
                << temp_pdb.value() << "\".";
   }
@@ -584,6 +604,9 @@ bool WriteSyzygyBlockGraphStream(const PEFile& pe_file,
   block_graph::BlockGraphSerializer::Attributes attributes = 0;
   if (strip_strings)
     attributes |= block_graph::BlockGraphSerializer::OMIT_STRINGS;
+  // Delta encoding makes the compressed stream much smaller.
+  if (compress)
+    attributes |= block_graph::BlockGraphSerializer::DELTA_ENCODING;
 
   // And finally, perform the serialization.
   if (!SaveBlockGraphAndImageLayout(pe_file, attributes, image_layout,
@@ -598,12 +621,87 @@ bool WriteSyzygyBlockGraphStream(const PEFile& pe_file,
   return true;
 }
 
+// A stage of the relinker which doesn't depend on the stages running in the
+// meantime. It runs on a worker thread in parallel mode, and synchronously
+// when started otherwise. The thread is joined on destruction, so that the
+// early returns of Relink don't leave it running.
+class RelinkStage : public base::DelegateSimpleThread::Delegate {
+ public:
+  typedef base::Callback<bool(void)> StageCallback;
+
+  // @param name The name of the stage.
+  // @param callback The work of the stage.
+  RelinkStage(const char* name, const StageCallback& callback)
+      : name_(name), callback_(callback), done_(false), result_(false) {
+  }
+
+  ~RelinkStage() {
+    Join();
+  }
+
+  // Starts the stage.
+  // @param parallel If true, the stage runs on a worker thread.
+  void Start(bool parallel) {
+    DCHECK(!done_);
+    DCHECK(thread_.get() == NULL);
+    if (!parallel) {
+      Run();
+      return;
+    }
+    thread_.reset(new base::DelegateSimpleThread(this, name_));
+    thread_->Start();
+  }
+
+  // Waits for the stage to complete.
+  // @returns the result of the stage.
+  bool Join() {
+    if (thread_.get() != NULL) {
+      thread_->Join();
+      thread_.reset();
+    }
+    return result_;
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  virtual void Run() OVERRIDE {
+    ScopedStageTimer timer(name_);
+    result_ = callback_.Run();
+    done_ = true;
+  }
+  // @}
+
+ private:
+  const char* name_;
+  StageCallback callback_;
+  scoped_ptr<base::DelegateSimpleThread> thread_;
+  bool done_;
+  bool result_;
+
+  DISALLOW_COPY_AND_ASSIGN(RelinkStage);
+};
+
+// Reads the PDB file.
+bool ReadPdbFile(const base::FilePath& pdb_path, PdbFile* pdb_file) {
+  DCHECK(pdb_file != NULL);
+
+  LOG(INFO) << "Reading PDB file: " << pdb_path.value();
+  pdb::PdbReader pdb_reader;
+  if (!pdb_reader.Read(pdb_path, pdb_file)) {
+    LOG(ERROR) << "Unable to read PDB file: " << pdb_path.value();
+    return false;
+  }
+
+  return true;
+}
+
 }  // namespace
 
 PERelinker::PERelinker(const PETransformPolicy* transform_policy)
     : PECoffRelinker(transform_policy),
       add_metadata_(true), augment_pdb_(true),
-      compress_pdb_(false), parse_debug_info_(true), strip_strings_(false),
+      compress_pdb_(false), incremental_pdb_(false), parse_debug_info_(true),
+      strip_strings_(false), parallel_relink_(false),
       use_new_decomposer_(false), padding_(0), code_alignment_(1),
       output_guid_(GUID_NULL) {
   DCHECK(transform_policy != NULL);
@@ -667,6 +765,14 @@ bool PERelinker::Relink() {
     return false;
   }
 
+  // The input PDB file doesn't depend on the image, so it's read while the
+  // image gets transformed, ordered and laid out.
+  PdbFile pdb_file;
+  RelinkStage read_pdb_stage(
+      "PERelinker: read PDB",
+      base::Bind(&ReadPdbFile, input_pdb_path_, base::Unretained(&pdb_file)));
+  read_pdb_stage.Start(parallel_relink_);
+
   // Transform it. In addition to user-supplied transforms, we apply the
   // following mandatory extra transforms for PE, in order:
   //  1. Add metadata if asked to.
@@ -685,8 +791,11 @@ bool PERelinker::Relink() {
   post_transforms.push_back(&add_pdb_info_tx);
   post_transforms.push_back(&prep_headers_tx);
 
-  if (!ApplyTransforms(post_transforms))
-    return false;
+  {
+    ScopedStageTimer timer("PERelinker: transform");
+    if (!ApplyTransforms(post_transforms))
+      return false;
+  }
 
   // Order it.
   std::vector<Orderer*> post_orderers;
@@ -694,30 +803,44 @@ bool PERelinker::Relink() {
   post_orderers.push_back(&pe_orderer);
 
   OrderedBlockGraph ordered_block_graph(&block_graph_);
-  if (!ApplyOrderers(post_orderers, &ordered_block_graph))
-    return false;
+  {
+    ScopedStageTimer timer("PERelinker: order");
+    if (!ApplyOrderers(post_orderers, &ordered_block_graph))
+      return false;
+  }
 
   // Lay it out.
   ImageLayout output_image_layout(&block_graph_);
-  if (!BuildImageLayout(padding_, code_alignment_,
-                        ordered_block_graph, headers_block_,
-                        &output_image_layout)) {
-    return false;
+  {
+    ScopedStageTimer timer("PERelinker: build layout");
+    size_t num_threads = 1;
+    if (parallel_relink_)
+      num_threads = base::SysInfo::NumberOfProcessors();
+    if (!BuildImageLayout(padding_, code_alignment_, num_threads,
+                          ordered_block_graph, headers_block_,
+                          &output_image_layout)) {
+      return false;
+    }
   }
 
-  // Write the image.
-  if (!WriteImage(output_image_layout, output_path_))
-    return false;
+  // Write the image. The layout is final from here on, so the PDB can be
+  // updated while the image is being written.
+  RelinkStage write_image_stage(
+      "PERelinker: write image",
+      base::Bind(&WriteImage, base::ConstRef(output_image_layout),
+                 output_path_));
+  write_image_stage.Start(parallel_relink_);
 
   // From here on down we are processing the PDB file.
-
-  // Read the PDB file.
-  LOG(INFO) << "Reading PDB file: " << input_pdb_path_.value();
-  pdb::PdbReader pdb_reader;
-  PdbFile pdb_file;
-  if (!pdb_reader.Read(input_pdb_path_, &pdb_file)) {
-    LOG(ERROR) << "Unable to read PDB file: " << input_pdb_path_.value();
+  if (!read_pdb_stage.Join())
     return false;
+
+  // Keep track of the original streams, so that the unmodified ones can be
+  // copied as is when writing the PDB incrementally.
+  PdbFile source_pdb_file;
+  if (incremental_pdb_) {
+    for (size_t i = 0; i < pdb_file.StreamCount(); ++i)
+      source_pdb_file.AppendStream(pdb_file.GetStream(i));
   }
 
   // Apply the mutators to the PDB file.
@@ -749,6 +872,10 @@ bool PERelinker::Relink() {
   if (augment_pdb_) {
     LOG(INFO) << "The block-graph stream is being written to the PDB.";
 
+    // This reads back the image, it has to be written first.
+    if (!write_image_stage.Join())
+      return false;
+
     PEFile new_pe_file;
     if (!new_pe_file.Init(output_path_)) {
       LOG(ERROR) << "Failed to read newly written PE file.";
@@ -777,7 +904,15 @@ bool PERelinker::Relink() {
 
   // Write the PDB file. We use a helper function that first writes it to a
   // temporary file and then moves it, enabling overwrites.
-  if (!WritePdbFile(output_pdb_path_, pdb_file))
+  {
+    ScopedStageTimer timer("PERelinker: write PDB");
+    if (!WritePdbFile(output_pdb_path_, pdb_file, input_pdb_path_,
+                      incremental_pdb_ ? &source_pdb_file : NULL)) {
+      return false;
+    }
+  }
+
+  if (!write_image_stage.Join())
     return false;
 
   return true;
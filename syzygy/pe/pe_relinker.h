@@ -99,6 +99,10 @@ namespace pe {
 //    ImageLayout.
 // 5. Image and accompanying PDB file are written. (Filenames are inferred from
 //    input filenames or directly specified.)
+//
+// The input PDB file is read independently of steps 2 to 4, and the image is
+// written independently of most of the PDB updates. In parallel mode these
+// run on worker threads. The time taken by each stage is logged.
 class PERelinker : public PECoffRelinker {
  public:
   // Constructor.
@@ -115,8 +119,10 @@ class PERelinker : public PECoffRelinker {
   bool add_metadata() const { return add_metadata_; }
   bool augment_pdb() const { return augment_pdb_; }
   bool compress_pdb() const { return compress_pdb_; }
+  bool incremental_pdb() const { return incremental_pdb_; }
   bool parse_debug_info() const { return parse_debug_info_; }
   bool strip_strings() const { return strip_strings_; }
+  bool parallel_relink() const { return parallel_relink_; }
   bool use_new_decomposer() const { return use_new_decomposer_; }
   size_t padding() const { return padding_; }
   size_t code_alignment() const { return code_alignment_; }
@@ -139,12 +145,18 @@ class PERelinker : public PECoffRelinker {
   void set_compress_pdb(bool compress_pdb) {
     compress_pdb_ = compress_pdb;
   }
+  void set_incremental_pdb(bool incremental_pdb) {
+    incremental_pdb_ = incremental_pdb;
+  }
   void set_parse_debug_info(bool parse_debug_info) {
     parse_debug_info_ = parse_debug_info;
   }
   void set_strip_strings(bool strip_strings) {
     strip_strings_ = strip_strings;
   }
+  void set_parallel_relink(bool parallel_relink) {
+    parallel_relink_ = parallel_relink;
+  }
   void set_use_new_decomposer(bool use_new_decomposer) {
     use_new_decomposer_ = use_new_decomposer;
   }
@@ -205,15 +217,22 @@ class PERelinker : public PECoffRelinker {
   // If true, the PDB will be augmented with a serialized block-graph and
   // image layout. Defaults to true.
   bool augment_pdb_;
-  // If true, then the augmented PDB stream will be compressed as it is written.
-  // Defaults to false.
+  // If true, then the augmented PDB stream will be delta encoded and
+  // compressed as it is written. Defaults to false.
   bool compress_pdb_;
+  // If true, the output PDB is written by copying the input PDB and appending
+  // only the streams that were modified. Defaults to false.
+  bool incremental_pdb_;
   // If true, then the decomposition will parse full symbol information.
   // Defaults to true.
   bool parse_debug_info_;
   // If true, strings associated with a block-graph will not be serialized into
   // the PDB. Defaults to false.
   bool strip_strings_;
+  // If true, the input PDB is read on a worker thread while the image is
+  // transformed, ordered and laid out, and the image is written on a worker
+  // thread while the PDB is updated. Defaults to false.
+  bool parallel_relink_;
   // If true we will use the new decomposer. Defaults to false.
   bool use_new_decomposer_;
   // Indicates the amount of padding to be added between blocks. Zero is the
@@ -156,6 +156,12 @@ TEST_F(PERelinkerTest, Properties) {
   relinker.set_strip_strings(false);
   EXPECT_FALSE(relinker.strip_strings());
 
+  EXPECT_FALSE(relinker.parallel_relink());
+  relinker.set_parallel_relink(true);
+  EXPECT_TRUE(relinker.parallel_relink());
+  relinker.set_parallel_relink(false);
+  EXPECT_FALSE(relinker.parallel_relink());
+
   EXPECT_FALSE(relinker.use_new_decomposer());
   relinker.set_use_new_decomposer(true);
   EXPECT_TRUE(relinker.use_new_decomposer());
@@ -401,6 +407,54 @@ TEST_F(PERelinkerTest, IdentityRelinkNewDecomposer) {
   EXPECT_EQ(pdb_path, relinker.output_pdb_path());
 }
 
+TEST_F(PERelinkerTest, ParallelRelink) {
+  TestPERelinker relinker(&policy_);
+
+  relinker.set_input_path(input_dll_);
+  relinker.set_output_path(temp_dll_);
+  relinker.set_parallel_relink(true);
+
+  EXPECT_TRUE(relinker.Init());
+  EXPECT_TRUE(relinker.Relink());
+
+  EXPECT_TRUE(file_util::PathExists(relinker.output_path()));
+  EXPECT_TRUE(file_util::PathExists(relinker.output_pdb_path()));
+
+  ASSERT_NO_FATAL_FAILURE(CheckTestDll(relinker.output_path()));
+
+  base::FilePath pdb_path;
+  ASSERT_TRUE(FindPdbForModule(relinker.output_path(), &pdb_path));
+  EXPECT_EQ(pdb_path, relinker.output_pdb_path());
+}
+
+TEST_F(PERelinkerTest, ParallelRelinkFailsWhenTransformFails) {
+  TestPERelinker relinker(&policy_);
+  StrictMock<MockTransform> transform;
+
+  EXPECT_CALL(transform, TransformBlockGraph(_, _, _)).WillOnce(Return(false));
+
+  relinker.AppendTransform(&transform);
+  relinker.set_input_path(input_dll_);
+  relinker.set_output_path(temp_dll_);
+  relinker.set_parallel_relink(true);
+  EXPECT_TRUE(relinker.Init());
+  EXPECT_FALSE(relinker.Relink());
+}
+
+TEST_F(PERelinkerTest, ParallelRelinkFailsWhenPdbMutatorFails) {
+  TestPERelinker relinker(&policy_);
+  StrictMock<MockPdbMutator> pdb_mutator;
+
+  EXPECT_CALL(pdb_mutator, MutatePdb(_)).WillOnce(Return(false));
+
+  relinker.AppendPdbMutator(&pdb_mutator);
+  relinker.set_input_path(input_dll_);
+  relinker.set_output_path(temp_dll_);
+  relinker.set_parallel_relink(true);
+  EXPECT_TRUE(relinker.Init());
+  EXPECT_FALSE(relinker.Relink());
+}
+
 TEST_F(PERelinkerTest, BlockGraphStreamIsCreated) {
   TestPERelinker relinker(&policy_);
 
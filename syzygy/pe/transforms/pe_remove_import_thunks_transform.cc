@@ -0,0 +1,268 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pe/transforms/pe_remove_import_thunks_transform.h"
+
+#include <windows.h>
+
+#include "base/logging.h"
+#include "syzygy/block_graph/basic_block.h"
+#include "syzygy/block_graph/basic_block_assembler.h"
+#include "syzygy/block_graph/typed_block.h"
+#include "syzygy/core/disassembler_util.h"
+
+namespace pe {
+namespace transforms {
+
+namespace {
+
+using block_graph::BasicBlock;
+using block_graph::BasicBlockAssembler;
+using block_graph::BasicBlockReference;
+using block_graph::BasicCodeBlock;
+using block_graph::BlockGraph;
+using block_graph::Displacement;
+using block_graph::Instruction;
+using block_graph::Operand;
+using block_graph::Successor;
+using block_graph::TypedBlock;
+
+typedef TypedBlock<IMAGE_DOS_HEADER> DosHeader;
+typedef TypedBlock<IMAGE_NT_HEADERS> NtHeaders;
+typedef TypedBlock<IMAGE_THUNK_DATA32> ImageThunkData32;
+
+// The encoding of 'jmp dword ptr [abs32]', and the offset of its operand.
+const uint8 kThunkOpcode[] = { 0xFF, 0x25 };
+const BlockGraph::Offset kThunkOperandOffset = sizeof(kThunkOpcode);
+const BlockGraph::Size kThunkSize = kThunkOperandOffset + sizeof(uint32);
+
+// @param thunk_ref The reference of an import thunk to the IAT.
+// @returns the operand addressing the IAT entry referenced by @p thunk_ref.
+Operand GetImportOperand(const BlockGraph::Reference& thunk_ref) {
+  return Operand(Displacement(thunk_ref.referenced(), thunk_ref.offset()));
+}
+
+// @param ref A reference of a basic block.
+// @returns true if @p ref points to the start of a block.
+bool IsBlockStartReference(const BasicBlockReference& ref) {
+  return ref.referred_type() == BasicBlockReference::REFERRED_TYPE_BLOCK &&
+      ref.offset() == 0 && ref.base() == 0;
+}
+
+}  // namespace
+
+const char PERemoveImportThunksTransform::kTransformName[] =
+    "PERemoveImportThunksTransform";
+
+PERemoveImportThunksTransform::PERemoveImportThunksTransform()
+    : rewritten_call_count_(0), removed_thunk_count_(0) {
+}
+
+bool PERemoveImportThunksTransform::PreBlockGraphIteration(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockGraph::Block* header_block) {
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+  DCHECK(header_block != NULL);
+
+  DosHeader dos_header;
+  NtHeaders nt_headers;
+  if (!dos_header.Init(0, header_block) ||
+      !dos_header.Dereference(dos_header->e_lfanew, &nt_headers)) {
+    LOG(ERROR) << "Unable to cast image headers.";
+    return false;
+  }
+
+  // An image without an IAT has no import thunks.
+  IMAGE_DATA_DIRECTORY* iat_directory =
+      nt_headers->OptionalHeader.DataDirectory + IMAGE_DIRECTORY_ENTRY_IAT;
+  ImageThunkData32 iat;
+  if (!nt_headers.HasReference(iat_directory->VirtualAddress) ||
+      !nt_headers.Dereference(iat_directory->VirtualAddress, &iat)) {
+    return true;
+  }
+
+  FindImportThunks(block_graph, iat.block());
+  return true;
+}
+
+bool PERemoveImportThunksTransform::OnBlock(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockGraph::Block* block) {
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+  DCHECK(block != NULL);
+
+  if (block->type() != BlockGraph::CODE_BLOCK || thunks_.empty())
+    return true;
+
+  // Only the blocks referring to a thunk need to be rewritten.
+  bool refers_to_thunk = false;
+  BlockGraph::Block::ReferenceMap::const_iterator ref_it =
+      block->references().begin();
+  for (; ref_it != block->references().end(); ++ref_it) {
+    if (thunks_.count(ref_it->second.referenced()) != 0) {
+      refers_to_thunk = true;
+      break;
+    }
+  }
+  if (!refers_to_thunk)
+    return true;
+
+  if (!policy->CodeBlockIsSafeToBasicBlockDecompose(block))
+    return true;
+
+  if (!ApplyBasicBlockSubGraphTransform(this, policy, block_graph, block, NULL))
+    return false;
+
+  return true;
+}
+
+bool PERemoveImportThunksTransform::PostBlockGraphIteration(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockGraph::Block* header_block) {
+  DCHECK(block_graph != NULL);
+
+  ThunkMap::iterator thunk_it = thunks_.begin();
+  for (; thunk_it != thunks_.end(); ++thunk_it) {
+    BlockGraph::Block* thunk = thunk_it->first;
+    if (!thunk->referrers().empty())
+      continue;
+
+    if (!thunk->RemoveAllReferences() || !block_graph->RemoveBlock(thunk)) {
+      LOG(ERROR) << "Unable to remove import thunk \"" << thunk->name()
+                 << "\".";
+      return false;
+    }
+    ++removed_thunk_count_;
+  }
+  thunks_.clear();
+
+  LOG(INFO) << "Rewrote " << rewritten_call_count_ << " calls through import "
+            << "thunks, and removed " << removed_thunk_count_ << " thunks.";
+  return true;
+}
+
+bool PERemoveImportThunksTransform::TransformBasicBlockSubGraph(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BasicBlockSubGraph* basic_block_subgraph) {
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+  DCHECK(basic_block_subgraph != NULL);
+
+  BasicBlockSubGraph::BBCollection::iterator bb_it =
+      basic_block_subgraph->basic_blocks().begin();
+  for (; bb_it != basic_block_subgraph->basic_blocks().end(); ++bb_it) {
+    BasicCodeBlock* bb = BasicCodeBlock::Cast(*bb_it);
+    if (bb == NULL)
+      continue;
+
+    // Rewrite the direct calls to a thunk.
+    BasicBlock::Instructions& instructions = bb->instructions();
+    BasicBlock::Instructions::iterator instr_it = instructions.begin();
+    while (instr_it != instructions.end()) {
+      const BlockGraph::Reference* thunk_ref = NULL;
+      if (instr_it->IsCall() &&
+          instr_it->representation().ops[0].type == O_PC &&
+          instr_it->references().size() == 1) {
+        const BasicBlockReference& ref = instr_it->references().begin()->second;
+        if (IsBlockStartReference(ref))
+          thunk_ref = GetThunkReference(ref.block());
+      }
+      if (thunk_ref == NULL) {
+        ++instr_it;
+        continue;
+      }
+
+      BasicBlockAssembler assm(instr_it, &instructions);
+      assm.call(GetImportOperand(*thunk_ref));
+      BasicBlock::Instructions::iterator call_it = instr_it;
+      --call_it;
+      call_it->set_source_range(instr_it->source_range());
+      if (instr_it->has_label())
+        call_it->set_label(instr_it->label());
+      instr_it = instructions.erase(instr_it);
+      ++rewritten_call_count_;
+    }
+
+    // Rewrite the tail calls to a thunk, which end the basic block with an
+    // indirect jump instead.
+    if (bb->successors().size() != 1)
+      continue;
+    const Successor& jump = bb->successors().front();
+    if (jump.condition() != Successor::kConditionTrue ||
+        !IsBlockStartReference(jump.reference())) {
+      continue;
+    }
+    const BlockGraph::Reference* thunk_ref =
+        GetThunkReference(jump.reference().block());
+    if (thunk_ref == NULL)
+      continue;
+
+    BasicBlockAssembler assm(instructions.end(), &instructions);
+    assm.jmp(GetImportOperand(*thunk_ref));
+    instructions.back().set_source_range(jump.source_range());
+    bb->successors().clear();
+    ++rewritten_call_count_;
+  }
+
+  return true;
+}
+
+void PERemoveImportThunksTransform::FindImportThunks(
+    BlockGraph* block_graph, const BlockGraph::Block* iat_block) {
+  DCHECK(block_graph != NULL);
+  DCHECK(iat_block != NULL);
+
+  thunks_.clear();
+  BlockGraph::BlockMap::iterator block_it =
+      block_graph->blocks_mutable().begin();
+  for (; block_it != block_graph->blocks_mutable().end(); ++block_it) {
+    BlockGraph::Block* block = &block_it->second;
+    if (block->type() != BlockGraph::CODE_BLOCK ||
+        block->size() != kThunkSize ||
+        block->data_size() != kThunkSize ||
+        ::memcmp(block->data(), kThunkOpcode, sizeof(kThunkOpcode)) != 0 ||
+        block->references().size() != 1) {
+      continue;
+    }
+
+    BlockGraph::Reference ref;
+    if (!block->GetReference(kThunkOperandOffset, &ref) ||
+        ref.type() != BlockGraph::ABSOLUTE_REF ||
+        ref.size() != sizeof(uint32) ||
+        ref.referenced() != iat_block ||
+        ref.offset() != ref.base()) {
+      continue;
+    }
+
+    thunks_[block] = ref;
+  }
+}
+
+const BlockGraph::Reference* PERemoveImportThunksTransform::GetThunkReference(
+    const BlockGraph::Block* block) const {
+  ThunkMap::const_iterator thunk_it =
+      thunks_.find(const_cast<BlockGraph::Block*>(block));
+  if (thunk_it == thunks_.end())
+    return NULL;
+  return &thunk_it->second;
+}
+
+}  // namespace transforms
+}  // namespace pe
@@ -0,0 +1,114 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a PE-specific transform which calls the imported functions
+// directly through the import address table, rather than through the jump
+// thunks the linker emits for the functions which weren't declared as
+// imported.
+
+#ifndef SYZYGY_PE_TRANSFORMS_PE_REMOVE_IMPORT_THUNKS_TRANSFORM_H_
+#define SYZYGY_PE_TRANSFORMS_PE_REMOVE_IMPORT_THUNKS_TRANSFORM_H_
+
+#include <map>
+
+#include "syzygy/block_graph/transforms/iterative_transform.h"
+#include "syzygy/block_graph/transforms/named_transform.h"
+
+namespace pe {
+namespace transforms {
+
+// An iterative transform that removes the import thunks: the code blocks
+// consisting of a single 'jmp [IAT entry]' instruction. The calls and the
+// jumps to a thunk are rewritten to 'call [IAT entry]' and 'jmp [IAT entry]',
+// which saves an indirect jump per call. The thunks left without referrers
+// are removed from the block graph.
+//
+// Only the referrers which the policy deems safe to decompose are rewritten.
+// A thunk whose address is taken, or which is called from a block that can't
+// be decomposed, is left in place.
+class PERemoveImportThunksTransform
+    : public block_graph::transforms::IterativeTransformImpl<
+          PERemoveImportThunksTransform>,
+      public block_graph::transforms::NamedBasicBlockSubGraphTransformImpl<
+          PERemoveImportThunksTransform> {
+ public:
+  typedef block_graph::BasicBlockSubGraph BasicBlockSubGraph;
+  typedef block_graph::BlockGraph BlockGraph;
+  typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
+
+  PERemoveImportThunksTransform();
+
+  // @name Statistics, valid after the transform has been applied.
+  // @{
+  size_t rewritten_call_count() const { return rewritten_call_count_; }
+  size_t removed_thunk_count() const { return removed_thunk_count_; }
+  // @}
+
+  // The transform name.
+  static const char kTransformName[];
+
+ protected:
+  friend IterativeTransformImpl<PERemoveImportThunksTransform>;
+
+  // Maps each thunk to its reference to the IAT.
+  typedef std::map<BlockGraph::Block*, BlockGraph::Reference> ThunkMap;
+
+  // @name IterativeTransformImpl implementation.
+  // @{
+  bool PreBlockGraphIteration(const TransformPolicyInterface* policy,
+                              BlockGraph* block_graph,
+                              BlockGraph::Block* header_block);
+  bool OnBlock(const TransformPolicyInterface* policy,
+               BlockGraph* block_graph,
+               BlockGraph::Block* block);
+  bool PostBlockGraphIteration(const TransformPolicyInterface* policy,
+                               BlockGraph* block_graph,
+                               BlockGraph::Block* header_block);
+  // @}
+
+  // @name BasicBlockSubGraphTransformInterface implementation.
+  // @{
+  virtual bool TransformBasicBlockSubGraph(
+      const TransformPolicyInterface* policy,
+      BlockGraph* block_graph,
+      BasicBlockSubGraph* basic_block_subgraph) OVERRIDE;
+  // @}
+
+  // Finds the thunks jumping through an import address table.
+  // @param block_graph The block graph to search.
+  // @param iat_block The block containing the import address table.
+  void FindImportThunks(BlockGraph* block_graph,
+                        const BlockGraph::Block* iat_block);
+
+  // @param block A block.
+  // @returns the reference of @p block to the IAT if it's an import thunk,
+  //     or NULL.
+  const BlockGraph::Reference* GetThunkReference(
+      const BlockGraph::Block* block) const;
+
+  // The import thunks of the image.
+  ThunkMap thunks_;
+
+  // The statistics.
+  size_t rewritten_call_count_;
+  size_t removed_thunk_count_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(PERemoveImportThunksTransform);
+};
+
+}  // namespace transforms
+}  // namespace pe
+
+#endif  // SYZYGY_PE_TRANSFORMS_PE_REMOVE_IMPORT_THUNKS_TRANSFORM_H_
@@ -0,0 +1,217 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pe/transforms/pe_remove_import_thunks_transform.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/unittest_util.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/pe/pe_relinker.h"
+#include "syzygy/pe/unittest_util.h"
+
+namespace pe {
+namespace transforms {
+
+namespace {
+
+using block_graph::BlockGraph;
+
+// jmp dword ptr [iat]
+const uint8 kThunk[] = { 0xFF, 0x25, 0x00, 0x00, 0x00, 0x00 };
+// call thunk; ret
+const uint8 kCaller[] = { 0xE8, 0x00, 0x00, 0x00, 0x00, 0xC3 };
+// jmp thunk
+const uint8 kTailCaller[] = { 0xE9, 0x00, 0x00, 0x00, 0x00 };
+
+class TestPERemoveImportThunksTransform : public PERemoveImportThunksTransform {
+ public:
+  using PERemoveImportThunksTransform::FindImportThunks;
+  using PERemoveImportThunksTransform::GetThunkReference;
+  using PERemoveImportThunksTransform::OnBlock;
+  using PERemoveImportThunksTransform::PostBlockGraphIteration;
+};
+
+class PERemoveImportThunksTransformTest : public testing::PELibUnitTest {
+ public:
+  PERemoveImportThunksTransformTest()
+      : iat_(NULL), thunk_(NULL), caller_(NULL), tail_caller_(NULL) {
+  }
+
+  virtual void SetUp() OVERRIDE {
+    BlockGraph::Section* text = block_graph_.AddSection(".text", 0);
+    ASSERT_TRUE(text != NULL);
+
+    iat_ = block_graph_.AddBlock(BlockGraph::DATA_BLOCK, 8, "IAT");
+    ASSERT_TRUE(iat_ != NULL);
+
+    thunk_ = AddCodeBlock("thunk", kThunk, sizeof(kThunk), text);
+    ASSERT_TRUE(thunk_ != NULL);
+    ASSERT_TRUE(thunk_->SetReference(2,
+        BlockGraph::Reference(BlockGraph::ABSOLUTE_REF, 4, iat_, 4, 4)));
+
+    caller_ = AddCodeBlock("caller", kCaller, sizeof(kCaller), text);
+    ASSERT_TRUE(caller_ != NULL);
+    ASSERT_TRUE(caller_->SetReference(1,
+        BlockGraph::Reference(BlockGraph::PC_RELATIVE_REF, 4, thunk_, 0, 0)));
+
+    tail_caller_ = AddCodeBlock("tail_caller", kTailCaller,
+                                sizeof(kTailCaller), text);
+    ASSERT_TRUE(tail_caller_ != NULL);
+    ASSERT_TRUE(tail_caller_->SetReference(1,
+        BlockGraph::Reference(BlockGraph::PC_RELATIVE_REF, 4, thunk_, 0, 0)));
+  }
+
+  BlockGraph::Block* AddCodeBlock(const char* name,
+                                  const uint8* data,
+                                  size_t size,
+                                  BlockGraph::Section* section) {
+    BlockGraph::Block* block =
+        block_graph_.AddBlock(BlockGraph::CODE_BLOCK, size, name);
+    block->SetData(data, size);
+    block->SetLabel(0, name, BlockGraph::CODE_LABEL);
+    block->set_section(section->id());
+    return block;
+  }
+
+  // Applies the transform to every block of the graph, as the iterative
+  // transform would, once the thunks have been found.
+  void ApplyTransform() {
+    transform_.FindImportThunks(&block_graph_, iat_);
+    ASSERT_TRUE(transform_.GetThunkReference(thunk_) != NULL);
+
+    std::vector<BlockGraph::Block*> blocks;
+    BlockGraph::BlockMap::iterator it = block_graph_.blocks_mutable().begin();
+    for (; it != block_graph_.blocks_mutable().end(); ++it)
+      blocks.push_back(&it->second);
+    for (size_t i = 0; i < blocks.size(); ++i)
+      ASSERT_TRUE(transform_.OnBlock(&policy_, &block_graph_, blocks[i]));
+
+    ASSERT_TRUE(transform_.PostBlockGraphIteration(
+        &policy_, &block_graph_, NULL));
+  }
+
+  // @returns the only block of the graph with the name @p name, or NULL.
+  BlockGraph::Block* FindBlock(const std::string& name) {
+    BlockGraph::Block* found = NULL;
+    BlockGraph::BlockMap::iterator it = block_graph_.blocks_mutable().begin();
+    for (; it != block_graph_.blocks_mutable().end(); ++it) {
+      if (it->second.name() != name)
+        continue;
+      EXPECT_TRUE(found == NULL);
+      found = &it->second;
+    }
+    return found;
+  }
+
+  // @returns true if @p block refers to the IAT entry used by the thunk.
+  bool RefersToImport(const BlockGraph::Block* block) {
+    BlockGraph::Block::ReferenceMap::const_iterator it =
+        block->references().begin();
+    for (; it != block->references().end(); ++it) {
+      if (it->second.referenced() == iat_ && it->second.offset() == 4)
+        return true;
+    }
+    return false;
+  }
+
+  testing::DummyTransformPolicy policy_;
+  TestPERemoveImportThunksTransform transform_;
+  BlockGraph block_graph_;
+  BlockGraph::Block* iat_;
+  BlockGraph::Block* thunk_;
+  BlockGraph::Block* caller_;
+  BlockGraph::Block* tail_caller_;
+};
+
+}  // namespace
+
+TEST_F(PERemoveImportThunksTransformTest, FindImportThunks) {
+  transform_.FindImportThunks(&block_graph_, iat_);
+
+  const BlockGraph::Reference* ref = transform_.GetThunkReference(thunk_);
+  ASSERT_TRUE(ref != NULL);
+  EXPECT_EQ(iat_, ref->referenced());
+  EXPECT_EQ(4, ref->offset());
+  EXPECT_TRUE(transform_.GetThunkReference(caller_) == NULL);
+  EXPECT_TRUE(transform_.GetThunkReference(tail_caller_) == NULL);
+
+  // A jump through another table isn't an import thunk.
+  BlockGraph::Block* other =
+      block_graph_.AddBlock(BlockGraph::DATA_BLOCK, 4, "other");
+  ASSERT_TRUE(thunk_->SetReference(2,
+      BlockGraph::Reference(BlockGraph::ABSOLUTE_REF, 4, other, 0, 0)));
+  transform_.FindImportThunks(&block_graph_, iat_);
+  EXPECT_TRUE(transform_.GetThunkReference(thunk_) == NULL);
+}
+
+TEST_F(PERemoveImportThunksTransformTest, RewriteCallsAndRemoveThunk) {
+  ASSERT_NO_FATAL_FAILURE(ApplyTransform());
+
+  EXPECT_EQ(2U, transform_.rewritten_call_count());
+  EXPECT_EQ(1U, transform_.removed_thunk_count());
+  EXPECT_TRUE(FindBlock("thunk") == NULL);
+
+  // The call is now 'call dword ptr [iat + 4]'.
+  BlockGraph::Block* caller = FindBlock("caller");
+  ASSERT_TRUE(caller != NULL);
+  ASSERT_EQ(7U, caller->size());
+  EXPECT_EQ(0xFF, caller->data()[0]);
+  EXPECT_EQ(0x15, caller->data()[1]);
+  EXPECT_EQ(0xC3, caller->data()[6]);
+  EXPECT_TRUE(RefersToImport(caller));
+
+  // The tail call is now 'jmp dword ptr [iat + 4]'.
+  BlockGraph::Block* tail_caller = FindBlock("tail_caller");
+  ASSERT_TRUE(tail_caller != NULL);
+  ASSERT_EQ(6U, tail_caller->size());
+  EXPECT_EQ(0xFF, tail_caller->data()[0]);
+  EXPECT_EQ(0x25, tail_caller->data()[1]);
+  EXPECT_TRUE(RefersToImport(tail_caller));
+}
+
+TEST_F(PERemoveImportThunksTransformTest, KeepReferencedThunk) {
+  // The address of the thunk is taken by some data.
+  BlockGraph::Block* data =
+      block_graph_.AddBlock(BlockGraph::DATA_BLOCK, 4, "data");
+  ASSERT_TRUE(data->SetReference(0,
+      BlockGraph::Reference(BlockGraph::ABSOLUTE_REF, 4, thunk_, 0, 0)));
+
+  ASSERT_NO_FATAL_FAILURE(ApplyTransform());
+
+  EXPECT_EQ(2U, transform_.rewritten_call_count());
+  EXPECT_EQ(0U, transform_.removed_thunk_count());
+  EXPECT_EQ(thunk_, FindBlock("thunk"));
+}
+
+TEST_F(PERemoveImportThunksTransformTest, RelinkTestDll) {
+  base::FilePath temp_dir;
+  CreateTemporaryDir(&temp_dir);
+  base::FilePath output_path = temp_dir.Append(testing::kTestDllName);
+
+  pe::PETransformPolicy policy;
+  pe::PERelinker relinker(&policy);
+  relinker.set_input_path(testing::GetExeRelativePath(testing::kTestDllName));
+  relinker.set_output_path(output_path);
+  relinker.set_allow_overwrite(true);
+  ASSERT_TRUE(relinker.Init());
+
+  PERemoveImportThunksTransform transform;
+  relinker.AppendTransform(&transform);
+  ASSERT_TRUE(relinker.Relink());
+
+  ASSERT_NO_FATAL_FAILURE(CheckTestDll(output_path));
+}
+
+}  // namespace transforms
+}  // namespace pe
@@ -39,6 +39,8 @@
         'pe_coff_add_imports_transform.h',
         'pe_prepare_headers_transform.cc',
         'pe_prepare_headers_transform.h',
+        'pe_remove_import_thunks_transform.cc',
+        'pe_remove_import_thunks_transform.h',
       ],
       'dependencies': [
         '<(src)/base/base.gyp:base',
@@ -62,11 +64,13 @@
         'pe_add_imports_transform_unittest.cc',
         'pe_coff_add_imports_transform_unittest.cc',
         'pe_prepare_headers_transform_unittest.cc',
+        'pe_remove_import_thunks_transform_unittest.cc',
         'pe_transforms_unittests_main.cc',
       ],
       'dependencies': [
         'pe_transforms_lib',
         '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/block_graph/block_graph.gyp:block_graph_unittest_lib',
         '<(src)/syzygy/core/core.gyp:core_unittest_utils',
         '<(src)/syzygy/pe/pe.gyp:pe_unittest_utils',
         '<(src)/syzygy/pe/pe.gyp:test_dll',
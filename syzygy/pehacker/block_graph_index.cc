@@ -0,0 +1,192 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pehacker/block_graph_index.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "base/string_util.h"
+
+namespace pehacker {
+
+namespace {
+
+typedef BlockGraphIndex::Block Block;
+typedef BlockGraphIndex::BlockVector BlockVector;
+
+bool BlockIdLess(const Block* block1, const Block* block2) {
+  return block1->id() < block2->id();
+}
+
+// Orders @p blocks by ID and removes the duplicates.
+void SortAndUnique(BlockVector* blocks) {
+  DCHECK(blocks != NULL);
+  std::sort(blocks->begin(), blocks->end(), BlockIdLess);
+  blocks->erase(std::unique(blocks->begin(), blocks->end()), blocks->end());
+}
+
+// Returns the literal prefix of a pattern, up to its first wildcard or escape
+// character.
+base::StringPiece GetLiteralPrefix(const base::StringPiece& pattern) {
+  size_t pos = pattern.find_first_of("*?\\");
+  if (pos == base::StringPiece::npos)
+    return pattern;
+  return pattern.substr(0, pos);
+}
+
+}  // namespace
+
+void BlockGraphIndex::Init(BlockGraph* block_graph) {
+  DCHECK(block_graph != NULL);
+
+  block_graph_ = block_graph;
+  name_index_.clear();
+  section_index_.clear();
+
+  BlockGraph::BlockMap::iterator it = block_graph->blocks_mutable().begin();
+  for (; it != block_graph->blocks_mutable().end(); ++it)
+    AddBlock(&it->second);
+}
+
+void BlockGraphIndex::AddBlock(Block* block) {
+  DCHECK(block != NULL);
+
+  name_index_.insert(std::make_pair(base::StringPiece(block->name()), block));
+  bool inserted = section_index_[block->section()].insert(
+      std::make_pair(block->id(), block)).second;
+  DCHECK(inserted);
+}
+
+void BlockGraphIndex::RemoveBlock(Block* block) {
+  DCHECK(block != NULL);
+
+  RemoveName(block);
+
+  SectionIndex::iterator section_it = section_index_.find(block->section());
+  DCHECK(section_it != section_index_.end());
+  size_t erased = section_it->second.erase(block->id());
+  DCHECK_EQ(1u, erased);
+  if (section_it->second.empty())
+    section_index_.erase(section_it);
+}
+
+void BlockGraphIndex::RenameBlock(Block* block,
+                                  const base::StringPiece& name) {
+  DCHECK(block != NULL);
+
+  RemoveName(block);
+  block->set_name(name);
+  name_index_.insert(std::make_pair(base::StringPiece(block->name()), block));
+}
+
+void BlockGraphIndex::SetBlockSection(Block* block,
+                                      BlockGraph::SectionId section) {
+  DCHECK(block != NULL);
+
+  RemoveBlock(block);
+  block->set_section(section);
+  AddBlock(block);
+}
+
+void BlockGraphIndex::FindBlocksByName(const base::StringPiece& name,
+                                       BlockVector* blocks) const {
+  DCHECK(blocks != NULL);
+
+  blocks->clear();
+  std::pair<NameIndex::const_iterator, NameIndex::const_iterator> range =
+      name_index_.equal_range(name);
+  for (; range.first != range.second; ++range.first)
+    blocks->push_back(range.first->second);
+  SortAndUnique(blocks);
+}
+
+void BlockGraphIndex::FindBlocksByPattern(const base::StringPiece& pattern,
+                                          BlockVector* blocks) const {
+  DCHECK(blocks != NULL);
+
+  base::StringPiece prefix = GetLiteralPrefix(pattern);
+  if (prefix.size() == pattern.size()) {
+    FindBlocksByName(pattern, blocks);
+    return;
+  }
+
+  // Only the names starting with the literal prefix can match.
+  blocks->clear();
+  NameIndex::const_iterator it = name_index_.lower_bound(prefix);
+  for (; it != name_index_.end() && it->first.starts_with(prefix); ++it) {
+    if (MatchPattern(it->first, pattern))
+      blocks->push_back(it->second);
+  }
+  SortAndUnique(blocks);
+}
+
+void BlockGraphIndex::FindBlocksInSection(BlockGraph::SectionId section,
+                                          BlockVector* blocks) const {
+  DCHECK(blocks != NULL);
+
+  blocks->clear();
+  SectionIndex::const_iterator section_it = section_index_.find(section);
+  if (section_it == section_index_.end())
+    return;
+
+  // The blocks of a section are already ordered by ID.
+  BlockIdMap::const_iterator it = section_it->second.begin();
+  for (; it != section_it->second.end(); ++it)
+    blocks->push_back(it->second);
+}
+
+void BlockGraphIndex::FindReferrers(const BlockVector& targets,
+                                    BlockVector* blocks) const {
+  DCHECK(blocks != NULL);
+
+  blocks->clear();
+  for (size_t i = 0; i < targets.size(); ++i) {
+    const Block::ReferrerSet& referrers = targets[i]->referrers();
+    Block::ReferrerSet::const_iterator it = referrers.begin();
+    for (; it != referrers.end(); ++it)
+      blocks->push_back(it->first);
+  }
+  SortAndUnique(blocks);
+}
+
+void BlockGraphIndex::FindReferenced(const BlockVector& sources,
+                                     BlockVector* blocks) const {
+  DCHECK(blocks != NULL);
+
+  blocks->clear();
+  for (size_t i = 0; i < sources.size(); ++i) {
+    const Block::ReferenceMap& references = sources[i]->references();
+    Block::ReferenceMap::const_iterator it = references.begin();
+    for (; it != references.end(); ++it)
+      blocks->push_back(it->second.referenced());
+  }
+  SortAndUnique(blocks);
+}
+
+void BlockGraphIndex::RemoveName(Block* block) {
+  DCHECK(block != NULL);
+
+  std::pair<NameIndex::iterator, NameIndex::iterator> range =
+      name_index_.equal_range(block->name());
+  for (; range.first != range.second; ++range.first) {
+    if (range.first->second == block) {
+      name_index_.erase(range.first);
+      return;
+    }
+  }
+  NOTREACHED() << "Block \"" << block->name() << "\" is not indexed.";
+}
+
+}  // namespace pehacker
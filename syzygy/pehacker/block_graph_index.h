@@ -0,0 +1,128 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares BlockGraphIndex, a set of indices over the blocks of a block graph
+// that lets the pehacker operations select blocks by name, name pattern,
+// section or reference relationships without scanning the whole graph. The
+// index is built once per image and kept up to date as operations edit the
+// graph, so that a batch of edits runs in near-linear time.
+
+#ifndef SYZYGY_PEHACKER_BLOCK_GRAPH_INDEX_H_
+#define SYZYGY_PEHACKER_BLOCK_GRAPH_INDEX_H_
+
+#include <map>
+#include <vector>
+
+#include "base/string_piece.h"
+#include "syzygy/block_graph/block_graph.h"
+
+namespace pehacker {
+
+class BlockGraphIndex {
+ public:
+  typedef block_graph::BlockGraph BlockGraph;
+  typedef BlockGraph::Block Block;
+  typedef std::vector<Block*> BlockVector;
+
+  BlockGraphIndex() : block_graph_(NULL) { }
+
+  // Builds the indices over all of the blocks of @p block_graph.
+  // @param block_graph the block graph to index. It must outlive this index.
+  void Init(BlockGraph* block_graph);
+
+  // @name Index maintenance. Operations that edit the block graph must keep
+  //     the index up to date through these.
+  // @{
+  // Adds a new block of the graph to the index.
+  // @param block the block to add.
+  void AddBlock(Block* block);
+
+  // Removes a block from the index. This must be called before the block is
+  // removed from the graph.
+  // @param block the block to remove.
+  void RemoveBlock(Block* block);
+
+  // Renames a block, updating the name index.
+  // @param block the block to rename.
+  // @param name the new name of the block.
+  void RenameBlock(Block* block, const base::StringPiece& name);
+
+  // Moves a block to another section, updating the section index.
+  // @param block the block to move.
+  // @param section the ID of its new section.
+  void SetBlockSection(Block* block, BlockGraph::SectionId section);
+  // @}
+
+  // @name Queries. The blocks are returned ordered by ID, without duplicates.
+  // @{
+  // Finds the blocks with a given name.
+  // @param name the name to look up.
+  // @param blocks receives the matching blocks.
+  void FindBlocksByName(const base::StringPiece& name,
+                        BlockVector* blocks) const;
+
+  // Finds the blocks whose name matches a pattern, which may contain the '*'
+  // and '?' wildcards. Only the names sharing the literal prefix of the
+  // pattern are considered.
+  // @param pattern the pattern to match.
+  // @param blocks receives the matching blocks.
+  void FindBlocksByPattern(const base::StringPiece& pattern,
+                           BlockVector* blocks) const;
+
+  // Finds the blocks in a section.
+  // @param section the ID of the section.
+  // @param blocks receives the blocks in @p section.
+  void FindBlocksInSection(BlockGraph::SectionId section,
+                           BlockVector* blocks) const;
+
+  // Finds the blocks that refer to any of the given blocks. This uses the
+  // referrers tracked by the blocks themselves, so it only visits the
+  // references involved.
+  // @param targets the referred-to blocks.
+  // @param blocks receives the referring blocks.
+  void FindReferrers(const BlockVector& targets, BlockVector* blocks) const;
+
+  // Finds the blocks that are referred to by any of the given blocks.
+  // @param sources the referring blocks.
+  // @param blocks receives the referred-to blocks.
+  void FindReferenced(const BlockVector& sources, BlockVector* blocks) const;
+  // @}
+
+  // @returns the number of blocks in the index.
+  size_t size() const { return name_index_.size(); }
+
+ protected:
+  // The blocks keyed by name. The keys point into the names of the blocks,
+  // which are interned by the block graph.
+  typedef std::multimap<base::StringPiece, Block*> NameIndex;
+  // The blocks of each section, keyed by ID.
+  typedef std::map<BlockGraph::BlockId, Block*> BlockIdMap;
+  typedef std::map<BlockGraph::SectionId, BlockIdMap> SectionIndex;
+
+  // Removes @p block from the name index.
+  void RemoveName(Block* block);
+
+  // The indexed block graph.
+  BlockGraph* block_graph_;
+
+  NameIndex name_index_;
+  SectionIndex section_index_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(BlockGraphIndex);
+};
+
+}  // namespace pehacker
+
+#endif  // SYZYGY_PEHACKER_BLOCK_GRAPH_INDEX_H_
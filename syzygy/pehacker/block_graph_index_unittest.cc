@@ -0,0 +1,175 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pehacker/block_graph_index.h"
+
+#include "gtest/gtest.h"
+
+namespace pehacker {
+
+namespace {
+
+typedef block_graph::BlockGraph BlockGraph;
+typedef BlockGraphIndex::BlockVector BlockVector;
+
+class BlockGraphIndexTest : public testing::Test {
+ public:
+  virtual void SetUp() OVERRIDE {
+    text_ = block_graph_.AddSection(".text", 0);
+    data_ = block_graph_.AddSection(".data", 0);
+
+    foo_ = AddBlock(BlockGraph::CODE_BLOCK, "Foo", text_);
+    foo_bar_ = AddBlock(BlockGraph::CODE_BLOCK, "FooBar", text_);
+    bar_ = AddBlock(BlockGraph::CODE_BLOCK, "Bar", text_);
+    data_foo_ = AddBlock(BlockGraph::DATA_BLOCK, "Foo", data_);
+
+    // Foo and FooBar both refer to Bar, and Bar refers to the data block.
+    AddReference(foo_, 0, bar_);
+    AddReference(foo_bar_, 0, bar_);
+    AddReference(foo_bar_, 4, bar_);
+    AddReference(bar_, 0, data_foo_);
+
+    index_.Init(&block_graph_);
+  }
+
+  BlockGraph::Block* AddBlock(BlockGraph::BlockType type,
+                              const char* name,
+                              BlockGraph::Section* section) {
+    BlockGraph::Block* block = block_graph_.AddBlock(type, 8, name);
+    block->set_section(section->id());
+    return block;
+  }
+
+  void AddReference(BlockGraph::Block* src,
+                    BlockGraph::Offset offset,
+                    BlockGraph::Block* dst) {
+    ASSERT_TRUE(src->SetReference(offset, BlockGraph::Reference(
+        BlockGraph::ABSOLUTE_REF, 4, dst, 0, 0)));
+  }
+
+  BlockGraph block_graph_;
+  BlockGraphIndex index_;
+
+  BlockGraph::Section* text_;
+  BlockGraph::Section* data_;
+  BlockGraph::Block* foo_;
+  BlockGraph::Block* foo_bar_;
+  BlockGraph::Block* bar_;
+  BlockGraph::Block* data_foo_;
+};
+
+}  // namespace
+
+TEST_F(BlockGraphIndexTest, FindBlocksByName) {
+  EXPECT_EQ(4u, index_.size());
+
+  BlockVector blocks;
+  index_.FindBlocksByName("Foo", &blocks);
+  ASSERT_EQ(2u, blocks.size());
+  EXPECT_EQ(foo_, blocks[0]);
+  EXPECT_EQ(data_foo_, blocks[1]);
+
+  index_.FindBlocksByName("Baz", &blocks);
+  EXPECT_TRUE(blocks.empty());
+}
+
+TEST_F(BlockGraphIndexTest, FindBlocksByPattern) {
+  BlockVector blocks;
+  index_.FindBlocksByPattern("Foo*", &blocks);
+  ASSERT_EQ(3u, blocks.size());
+  EXPECT_EQ(foo_, blocks[0]);
+  EXPECT_EQ(foo_bar_, blocks[1]);
+  EXPECT_EQ(data_foo_, blocks[2]);
+
+  index_.FindBlocksByPattern("*Bar", &blocks);
+  ASSERT_EQ(2u, blocks.size());
+  EXPECT_EQ(foo_bar_, blocks[0]);
+  EXPECT_EQ(bar_, blocks[1]);
+
+  index_.FindBlocksByPattern("B?r", &blocks);
+  ASSERT_EQ(1u, blocks.size());
+  EXPECT_EQ(bar_, blocks[0]);
+
+  // A pattern without wildcards is an exact lookup.
+  index_.FindBlocksByPattern("Bar", &blocks);
+  ASSERT_EQ(1u, blocks.size());
+  EXPECT_EQ(bar_, blocks[0]);
+}
+
+TEST_F(BlockGraphIndexTest, FindBlocksInSection) {
+  BlockVector blocks;
+  index_.FindBlocksInSection(text_->id(), &blocks);
+  ASSERT_EQ(3u, blocks.size());
+  EXPECT_EQ(foo_, blocks[0]);
+  EXPECT_EQ(foo_bar_, blocks[1]);
+  EXPECT_EQ(bar_, blocks[2]);
+
+  index_.FindBlocksInSection(data_->id(), &blocks);
+  ASSERT_EQ(1u, blocks.size());
+  EXPECT_EQ(data_foo_, blocks[0]);
+
+  index_.FindBlocksInSection(BlockGraph::kInvalidSectionId, &blocks);
+  EXPECT_TRUE(blocks.empty());
+}
+
+TEST_F(BlockGraphIndexTest, FindReferrersAndReferenced) {
+  BlockVector targets(1, bar_);
+  BlockVector blocks;
+  index_.FindReferrers(targets, &blocks);
+  ASSERT_EQ(2u, blocks.size());
+  EXPECT_EQ(foo_, blocks[0]);
+  EXPECT_EQ(foo_bar_, blocks[1]);
+
+  // Chained queries: what do the blocks referring to Bar refer to?
+  BlockVector referenced;
+  index_.FindReferenced(blocks, &referenced);
+  ASSERT_EQ(1u, referenced.size());
+  EXPECT_EQ(bar_, referenced[0]);
+
+  index_.FindReferenced(targets, &blocks);
+  ASSERT_EQ(1u, blocks.size());
+  EXPECT_EQ(data_foo_, blocks[0]);
+}
+
+TEST_F(BlockGraphIndexTest, Maintenance) {
+  index_.RenameBlock(foo_, "Baz");
+  EXPECT_EQ("Baz", foo_->name());
+  BlockVector blocks;
+  index_.FindBlocksByName("Foo", &blocks);
+  ASSERT_EQ(1u, blocks.size());
+  EXPECT_EQ(data_foo_, blocks[0]);
+  index_.FindBlocksByName("Baz", &blocks);
+  ASSERT_EQ(1u, blocks.size());
+  EXPECT_EQ(foo_, blocks[0]);
+
+  index_.SetBlockSection(foo_, data_->id());
+  EXPECT_EQ(data_->id(), foo_->section());
+  index_.FindBlocksInSection(data_->id(), &blocks);
+  EXPECT_EQ(2u, blocks.size());
+
+  BlockGraph::Block* qux = AddBlock(BlockGraph::CODE_BLOCK, "Qux", text_);
+  index_.AddBlock(qux);
+  EXPECT_EQ(5u, index_.size());
+  index_.FindBlocksByPattern("Q*", &blocks);
+  ASSERT_EQ(1u, blocks.size());
+  EXPECT_EQ(qux, blocks[0]);
+
+  index_.RemoveBlock(qux);
+  ASSERT_TRUE(block_graph_.RemoveBlock(qux));
+  EXPECT_EQ(4u, index_.size());
+  index_.FindBlocksByPattern("Q*", &blocks);
+  EXPECT_TRUE(blocks.empty());
+}
+
+}  // namespace pehacker
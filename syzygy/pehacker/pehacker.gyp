@@ -21,6 +21,8 @@
       'target_name': 'pehacker_lib',
       'type': 'static_library',
       'sources': [
+        'block_graph_index.cc',
+        'block_graph_index.h',
         'pehacker_app.cc',
         'pehacker_app.h',
       ],
@@ -52,6 +54,7 @@
       'target_name': 'pehacker_unittests',
       'type': 'executable',
       'sources': [
+        'block_graph_index_unittest.cc',
         'pehacker_app_unittest.cc',
         'pehacker_unittests_main.cc',
       ],
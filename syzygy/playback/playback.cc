@@ -142,6 +142,7 @@ bool Playback::LoadInstrumentedOmap() {
     return false;
   }
   LOG(INFO) << "Read OMAP data from instrumented module PDB.";
+  omap_to_translator_.Init(omap_to_);
 
   return true;
 }
@@ -255,7 +256,7 @@ const Playback::BlockGraph::Block* Playback::FindFunctionBlock(
 
   // Convert the address from one in the instrumented module to one in the
   // original module using the OMAP data.
-  rva = pdb::TranslateAddressViaOmap(omap_to(), rva);
+  rva = omap_to_translator_.Translate(rva);
 
   // Get the block that this function call refers to.
   const BlockGraph::Block* block = image_->blocks.GetBlockByAddress(rva);
@@ -274,4 +275,34 @@ const Playback::BlockGraph::Block* Playback::FindFunctionBlock(
   return block;
 }
 
+void Playback::FindDataBlocks(core::RelativeAddress rva,
+                              size_t size,
+                              block_graph::ConstBlockVector* blocks) const {
+  DCHECK(image_ != NULL);
+  DCHECK(blocks != NULL);
+
+  blocks->clear();
+  if (size == 0)
+    return;
+
+  // Convert the range from one in the instrumented module to one in the
+  // original module using the OMAP data. The instrumentation may move data
+  // around, so we fall back to the size of the original range if the mapped
+  // end doesn't follow the mapped start.
+  core::RelativeAddress start = omap_to_translator_.Translate(rva);
+  core::RelativeAddress last =
+      omap_to_translator_.Translate(rva + (size - 1));
+  size_t mapped_size = size;
+  if (last >= start)
+    mapped_size = last - start + 1;
+
+  BlockGraph::AddressSpace::RangeMapConstIterPair range =
+      image_->blocks.GetIntersectingBlocks(start, mapped_size);
+  for (; range.first != range.second; ++range.first) {
+    const BlockGraph::Block* block = range.first->second;
+    if (block->type() == BlockGraph::DATA_BLOCK)
+      blocks->push_back(block);
+  }
+}
+
 }  // namespace playback
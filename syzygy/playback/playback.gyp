@@ -23,6 +23,8 @@
       'sources': [
         'playback.cc',
         'playback.h',
+        'scenario.cc',
+        'scenario.h',
       ],
       'dependencies': [
         '<(src)/sawbuck/log_lib/log_lib.gyp:log_lib',
@@ -38,6 +40,7 @@
       'sources': [
         'playback_unittest.cc',
         'playback_unittests_main.cc',
+        'scenario_unittest.cc',
       ],
       'dependencies': [
         'playback_lib',
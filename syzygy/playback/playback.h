@@ -83,6 +83,16 @@ class Playback {
                                              FuncAddr function,
                                              bool* error);
 
+  // Gets the data blocks of our image that a range of the instrumented module
+  // maps to.
+  // @param rva The start of the range, relative to the instrumented module.
+  // @param size The size of the range.
+  // @param blocks Will receive the data blocks intersecting the range once
+  //     mapped to the original module, in address order.
+  void FindDataBlocks(core::RelativeAddress rva,
+                      size_t size,
+                      block_graph::ConstBlockVector* blocks) const;
+
   // @name Accessors
   // @{
   const PEFile* pe_file() const { return pe_file_; }
@@ -139,6 +149,9 @@ class Playback {
   std::vector<OMAP> omap_to_;
   std::vector<OMAP> omap_from_;
 
+  // Translates the addresses of events through omap_to_.
+  pdb::OmapTranslator omap_to_translator_;
+
   // Signature of the instrumented DLL. Used for filtering call-trace events.
   PEFile::Signature instr_signature_;
 };
@@ -217,4 +217,36 @@ TEST_F(PlaybackTest, FindFunctionBlock) {
   EXPECT_FALSE(error);
 }
 
+TEST_F(PlaybackTest, FindDataBlocks) {
+  EXPECT_TRUE(Init());
+  EXPECT_TRUE(playback_->Init(&input_dll_, &image_layout_, parser_.get()));
+
+  const IMAGE_SECTION_HEADER* text = input_dll_.GetSectionHeader(".text");
+  const IMAGE_SECTION_HEADER* data = input_dll_.GetSectionHeader(".data");
+  ASSERT_TRUE(text != NULL);
+  ASSERT_TRUE(data != NULL);
+
+  // The first page of data should map to data blocks only.
+  block_graph::ConstBlockVector blocks;
+  playback_->FindDataBlocks(core::RelativeAddress(data->VirtualAddress),
+                            4096,
+                            &blocks);
+  EXPECT_FALSE(blocks.empty());
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    EXPECT_EQ(block_graph::BlockGraph::DATA_BLOCK, blocks[i]->type());
+    if (i > 0)
+      EXPECT_LT(blocks[i - 1]->addr(), blocks[i]->addr());
+  }
+
+  // Code doesn't map to any data block, and neither does an empty range.
+  playback_->FindDataBlocks(core::RelativeAddress(text->VirtualAddress),
+                            1,
+                            &blocks);
+  EXPECT_TRUE(blocks.empty());
+  playback_->FindDataBlocks(core::RelativeAddress(data->VirtualAddress),
+                            0,
+                            &blocks);
+  EXPECT_TRUE(blocks.empty());
+}
+
 }  // namespace playback
@@ -0,0 +1,136 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/playback/scenario.h"
+
+#include "base/file_util.h"
+#include "base/values.h"
+#include "base/json/json_reader.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/utf_string_conversions.h"
+
+namespace playback {
+
+namespace {
+
+using base::DictionaryValue;
+using base::ListValue;
+using base::Value;
+
+const char kNameKey[] = "name";
+const char kWeightKey[] = "weight";
+const char kTracesKey[] = "traces";
+
+bool LoadScenario(const base::FilePath& base_dir,
+                  const DictionaryValue& dict,
+                  Scenario* scenario) {
+  DCHECK(scenario != NULL);
+
+  if (!dict.GetString(kNameKey, &scenario->name) ||
+      scenario->name.empty()) {
+    LOG(ERROR) << "Missing or invalid scenario " << kNameKey << ".";
+    return false;
+  }
+
+  // The weight is optional, and defaults to 1.
+  if (dict.HasKey(kWeightKey) &&
+      (!dict.GetDouble(kWeightKey, &scenario->weight) ||
+       scenario->weight < 0.0)) {
+    LOG(ERROR) << "Invalid " << kWeightKey << " for scenario \""
+               << scenario->name << "\".";
+    return false;
+  }
+
+  const ListValue* traces = NULL;
+  if (!dict.GetList(kTracesKey, &traces) || traces->GetSize() == 0) {
+    LOG(ERROR) << "Missing or empty " << kTracesKey << " for scenario \""
+               << scenario->name << "\".";
+    return false;
+  }
+  for (size_t i = 0; i < traces->GetSize(); ++i) {
+    std::string trace;
+    if (!traces->GetString(i, &trace) || trace.empty()) {
+      LOG(ERROR) << "Item " << i << " of " << kTracesKey << " for scenario \""
+                 << scenario->name << "\" is not a path.";
+      return false;
+    }
+    base::FilePath trace_path(UTF8ToWide(trace));
+    if (!trace_path.IsAbsolute())
+      trace_path = base_dir.Append(trace_path);
+    scenario->trace_files.push_back(trace_path);
+  }
+
+  return true;
+}
+
+}  // namespace
+
+bool LoadScenariosFromJSON(const base::FilePath& path,
+                           ScenarioVector* scenarios) {
+  DCHECK(scenarios != NULL);
+
+  std::string file_string;
+  if (!file_util::ReadFileToString(path, &file_string)) {
+    LOG(ERROR) << "Unable to read scenario file: " << path.value();
+    return false;
+  }
+
+  const ListValue* list = NULL;
+  scoped_ptr<Value> value(base::JSONReader::Read(file_string));
+  if (value.get() == NULL || !value->GetAsList(&list)) {
+    LOG(ERROR) << "Scenario file does not contain a valid JSON list.";
+    return false;
+  }
+
+  scenarios->clear();
+  scenarios->resize(list->GetSize());
+  for (size_t i = 0; i < list->GetSize(); ++i) {
+    const DictionaryValue* dict = NULL;
+    if (!list->GetDictionary(i, &dict)) {
+      LOG(ERROR) << "Item " << i << " of the scenario list is not a "
+                 << "dictionary.";
+      return false;
+    }
+    if (!LoadScenario(path.DirName(), *dict, &scenarios->at(i)))
+      return false;
+  }
+
+  if (scenarios->empty()) {
+    LOG(ERROR) << "Scenario file contains no scenarios.";
+    return false;
+  }
+
+  return true;
+}
+
+bool ConsumeScenario(const Scenario& scenario, trace::parser::Parser* parser) {
+  DCHECK(parser != NULL);
+
+  if (!parser->Close())
+    return false;
+
+  LOG(INFO) << "Processing scenario \"" << scenario.name << "\".";
+  for (size_t i = 0; i < scenario.trace_files.size(); ++i) {
+    const base::FilePath& trace_path = scenario.trace_files[i];
+    LOG(INFO) << "Opening '" << trace_path.BaseName().value() << "'.";
+    if (!parser->OpenTraceFile(trace_path)) {
+      LOG(ERROR) << "Unable to open trace log: " << trace_path.value();
+      return false;
+    }
+  }
+
+  return parser->Consume();
+}
+
+}  // namespace playback
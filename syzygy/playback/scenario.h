@@ -0,0 +1,74 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares Scenario, a named and weighted group of trace files captured while
+// exercising a module in a given way (startup, page load, idle, ...). The
+// scenarios are described in a JSON file of the following format:
+//
+// [
+//   {
+//     "name": "startup",
+//     "weight": 3.0,
+//     "traces": [ "startup-1.bin", "startup-2.bin" ]
+//   },
+//   ...
+// ]
+//
+// Relative trace file paths are relative to the directory of the scenario
+// file. Scenarios with a greater weight are more important.
+
+#ifndef SYZYGY_PLAYBACK_SCENARIO_H_
+#define SYZYGY_PLAYBACK_SCENARIO_H_
+
+#include <string>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "syzygy/trace/parse/parser.h"
+
+namespace playback {
+
+struct Scenario {
+  typedef std::vector<base::FilePath> TraceFileList;
+
+  Scenario() : weight(1.0) {
+  }
+
+  // The name of the scenario, used for reporting.
+  std::string name;
+  // The importance of the scenario, relative to the other scenarios.
+  double weight;
+  // The trace files captured for the scenario.
+  TraceFileList trace_files;
+};
+
+typedef std::vector<Scenario> ScenarioVector;
+
+// Loads a list of scenarios from a JSON file.
+// @param path the path of the scenario file.
+// @param scenarios receives the scenarios, in the order of the file.
+// @returns true on success, false on failure.
+bool LoadScenariosFromJSON(const base::FilePath& path,
+                           ScenarioVector* scenarios);
+
+// Consumes the trace files of a scenario. Any trace file previously opened by
+// @p parser is closed first, and won't be consumed.
+// @param scenario the scenario to consume.
+// @param parser the parser to use. This must already be initialized.
+// @returns true on success, false on failure.
+bool ConsumeScenario(const Scenario& scenario, trace::parser::Parser* parser);
+
+}  // namespace playback
+
+#endif  // SYZYGY_PLAYBACK_SCENARIO_H_
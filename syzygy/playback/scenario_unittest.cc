@@ -0,0 +1,104 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/playback/scenario.h"
+
+#include "base/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "gtest/gtest.h"
+
+namespace playback {
+
+namespace {
+
+class ScenarioTest : public testing::Test {
+ public:
+  virtual void SetUp() OVERRIDE {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    scenario_path_ = temp_dir_.path().Append(L"scenarios.json");
+  }
+
+  void WriteScenarioFile(const std::string& contents) {
+    ASSERT_EQ(static_cast<int>(contents.size()),
+              file_util::WriteFile(scenario_path_,
+                                   contents.data(),
+                                   contents.size()));
+  }
+
+  base::ScopedTempDir temp_dir_;
+  base::FilePath scenario_path_;
+};
+
+}  // namespace
+
+TEST_F(ScenarioTest, LoadScenariosFromJSON) {
+  ASSERT_NO_FATAL_FAILURE(WriteScenarioFile(
+      "[\n"
+      "  { \"name\": \"startup\", \"weight\": 3,\n"
+      "    \"traces\": [ \"startup-1.bin\", \"startup-2.bin\" ] },\n"
+      "  { \"name\": \"idle\", \"traces\": [ \"C:\\\\idle.bin\" ] }\n"
+      "]\n"));
+
+  ScenarioVector scenarios;
+  ASSERT_TRUE(LoadScenariosFromJSON(scenario_path_, &scenarios));
+  ASSERT_EQ(2U, scenarios.size());
+
+  EXPECT_EQ("startup", scenarios[0].name);
+  EXPECT_EQ(3.0, scenarios[0].weight);
+  ASSERT_EQ(2U, scenarios[0].trace_files.size());
+  EXPECT_EQ(temp_dir_.path().Append(L"startup-1.bin"),
+            scenarios[0].trace_files[0]);
+  EXPECT_EQ(temp_dir_.path().Append(L"startup-2.bin"),
+            scenarios[0].trace_files[1]);
+
+  // The weight defaults to 1, and absolute paths are left alone.
+  EXPECT_EQ("idle", scenarios[1].name);
+  EXPECT_EQ(1.0, scenarios[1].weight);
+  ASSERT_EQ(1U, scenarios[1].trace_files.size());
+  EXPECT_EQ(base::FilePath(L"C:\\idle.bin"), scenarios[1].trace_files[0]);
+}
+
+TEST_F(ScenarioTest, LoadScenariosFromJSONFailsForMissingFile) {
+  ScenarioVector scenarios;
+  EXPECT_FALSE(LoadScenariosFromJSON(scenario_path_, &scenarios));
+}
+
+TEST_F(ScenarioTest, LoadScenariosFromJSONFailsForInvalidScenarios) {
+  ScenarioVector scenarios;
+
+  // Not a list.
+  ASSERT_NO_FATAL_FAILURE(WriteScenarioFile("{}"));
+  EXPECT_FALSE(LoadScenariosFromJSON(scenario_path_, &scenarios));
+
+  // No scenarios.
+  ASSERT_NO_FATAL_FAILURE(WriteScenarioFile("[]"));
+  EXPECT_FALSE(LoadScenariosFromJSON(scenario_path_, &scenarios));
+
+  // Missing name.
+  ASSERT_NO_FATAL_FAILURE(WriteScenarioFile(
+      "[ { \"traces\": [ \"a.bin\" ] } ]"));
+  EXPECT_FALSE(LoadScenariosFromJSON(scenario_path_, &scenarios));
+
+  // Negative weight.
+  ASSERT_NO_FATAL_FAILURE(WriteScenarioFile(
+      "[ { \"name\": \"a\", \"weight\": -1, \"traces\": [ \"a.bin\" ] } ]"));
+  EXPECT_FALSE(LoadScenariosFromJSON(scenario_path_, &scenarios));
+
+  // No traces.
+  ASSERT_NO_FATAL_FAILURE(WriteScenarioFile(
+      "[ { \"name\": \"a\", \"traces\": [] } ]"));
+  EXPECT_FALSE(LoadScenariosFromJSON(scenario_path_, &scenarios));
+}
+
+}  // namespace playback
@@ -28,6 +28,7 @@
         '<(src)/base/base.gyp:base',
         '<(src)/sawbuck/common/common.gyp:common',
         '<(src)/syzygy/common/common.gyp:common_lib',
+        '<(src)/syzygy/common/common.gyp:stage_profiler_lib',
         '<(src)/syzygy/pdb/pdb.gyp:pdb_lib',
         '<(src)/syzygy/pe/orderers/pe_orderers.gyp:pe_orderers_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
@@ -18,6 +18,7 @@
 #include "syzygy/block_graph/orderers/original_orderer.h"
 #include "syzygy/block_graph/orderers/random_orderer.h"
 #include "syzygy/block_graph/transforms/fuzzing_transform.h"
+#include "syzygy/common/stage_profiler.h"
 #include "syzygy/pe/pe_relinker.h"
 #include "syzygy/pe/transforms/explode_basic_blocks_transform.h"
 #include "syzygy/reorder/orderers/explicit_orderer.h"
@@ -40,6 +41,8 @@ const char kUsageFormatStr[] =
     "    --exclude-bb-padding  When randomly reordering basic blocks, exclude\n"
     "                          padding and unreachable code from the relinked\n"
     "                          output binary.\n"
+    "    --incremental-pdb     Writes the output PDB by copying the input PDB\n"
+    "                          and appending only the modified streams.\n"
     "    --input-pdb=<path>    The PDB file associated with the input DLL.\n"
     "                          Default is inferred from input-image.\n"
     "    --no-augment-pdb      Indicates that the relinker should not augment\n"
@@ -54,6 +57,13 @@ const char kUsageFormatStr[] =
     "                          Default is inferred from output-image.\n"
     "    --overwrite           Allow output files to be overwritten.\n"
     "    --padding=<integer>   Add bytes of padding between blocks.\n"
+    "    --parallel-relink     Reads the input PDB and writes the output\n"
+    "                          image on worker threads, overlapping them with\n"
+    "                          the other stages of the relinker.\n"
+    "    --profile-output=<path>\n"
+    "                          Write the time spent in, and the memory used\n"
+    "                          by, each stage of the relinker to this JSON\n"
+    "                          file.\n"
     "    --code-alignment=<integer>\n"
     "                          Force a minimal alignment for code blocks.\n"
     "                          Default value is 1.\n"
@@ -118,11 +128,15 @@ bool RelinkApp::ParseCommandLine(const CommandLine* cmd_line) {
 
   output_pdb_path_ = cmd_line->GetSwitchValuePath("output-pdb");
   order_file_path_ = AbsolutePath(cmd_line->GetSwitchValuePath("order-file"));
+  profile_output_path_ =
+      AbsolutePath(cmd_line->GetSwitchValuePath("profile-output"));
   no_augment_pdb_ = cmd_line->HasSwitch("no-augment-pdb");
   compress_pdb_ = cmd_line->HasSwitch("compress-pdb");
+  incremental_pdb_ = cmd_line->HasSwitch("incremental-pdb");
   no_strip_strings_ = cmd_line->HasSwitch("no-strip-strings");
   output_metadata_ = !cmd_line->HasSwitch("no-metadata");
   overwrite_ = cmd_line->HasSwitch("overwrite");
+  parallel_relink_ = cmd_line->HasSwitch("parallel-relink");
   basic_blocks_ = cmd_line->HasSwitch("basic-blocks");
   exclude_bb_padding_ = cmd_line->HasSwitch("exclude-bb-padding");
   fuzz_ = cmd_line->HasSwitch("fuzz");
@@ -203,6 +217,8 @@ int RelinkApp::Run() {
   relinker.set_allow_overwrite(overwrite_);
   relinker.set_augment_pdb(!no_augment_pdb_);
   relinker.set_compress_pdb(compress_pdb_);
+  relinker.set_incremental_pdb(incremental_pdb_);
+  relinker.set_parallel_relink(parallel_relink_);
   relinker.set_strip_strings(!no_strip_strings_);
 
   // Initialize the relinker. This does the decomposition, etc.
@@ -276,6 +292,11 @@ int RelinkApp::Run() {
     return 1;
   }
 
+  if (!profile_output_path_.empty() &&
+      !common::StageProfiler::Instance()->SaveToFile(profile_output_path_)) {
+    return 1;
+  }
+
   return 0;
 }
 
@@ -35,9 +35,11 @@ class RelinkApp : public common::AppImplBase {
         code_alignment_(1),
         no_augment_pdb_(false),
         compress_pdb_(false),
+        incremental_pdb_(false),
         no_strip_strings_(false),
         output_metadata_(false),
         overwrite_(false),
+        parallel_relink_(false),
         basic_blocks_(false),
         exclude_bb_padding_(false),
         fuzz_(false) {
@@ -64,14 +66,17 @@ class RelinkApp : public common::AppImplBase {
   base::FilePath output_image_path_;
   base::FilePath output_pdb_path_;
   base::FilePath order_file_path_;
+  base::FilePath profile_output_path_;
   uint32 seed_;
   size_t padding_;
   size_t code_alignment_;
   bool no_augment_pdb_;
   bool compress_pdb_;
+  bool incremental_pdb_;
   bool no_strip_strings_;
   bool output_metadata_;
   bool overwrite_;
+  bool parallel_relink_;
   bool basic_blocks_;
   bool exclude_bb_padding_;
   bool fuzz_;
@@ -43,14 +43,17 @@ class TestRelinkApp : public RelinkApp {
   using RelinkApp::output_image_path_;
   using RelinkApp::output_pdb_path_;
   using RelinkApp::order_file_path_;
+  using RelinkApp::profile_output_path_;
   using RelinkApp::seed_;
   using RelinkApp::padding_;
   using RelinkApp::code_alignment_;
   using RelinkApp::no_augment_pdb_;
   using RelinkApp::compress_pdb_;
+  using RelinkApp::incremental_pdb_;
   using RelinkApp::no_strip_strings_;
   using RelinkApp::output_metadata_;
   using RelinkApp::overwrite_;
+  using RelinkApp::parallel_relink_;
   using RelinkApp::fuzz_;
 };
 
@@ -95,6 +98,7 @@ class RelinkAppTest : public testing::PELibUnitTest {
     output_image_path_ = temp_dir_.Append(input_image_path_.BaseName());
     output_pdb_path_ = temp_dir_.Append(input_pdb_path_.BaseName());
     order_file_path_ = temp_dir_.Append(L"order.json");
+    profile_output_path_ = temp_dir_.Append(L"profile.json");
 
     // Point the application at the test's command-line and IO streams.
     test_app_.set_command_line(&cmd_line_);
@@ -144,6 +148,7 @@ class RelinkAppTest : public testing::PELibUnitTest {
   base::FilePath output_image_path_;
   base::FilePath output_pdb_path_;
   base::FilePath order_file_path_;
+  base::FilePath profile_output_path_;
   uint32 seed_;
   size_t padding_;
   size_t code_alignment_;
@@ -235,9 +240,11 @@ TEST_F(RelinkAppTest, ParseMinimalCommandLineWithOrderFile) {
   EXPECT_EQ(1, test_impl_.code_alignment_);
   EXPECT_FALSE(test_impl_.no_augment_pdb_);
   EXPECT_FALSE(test_impl_.compress_pdb_);
+  EXPECT_FALSE(test_impl_.incremental_pdb_);
   EXPECT_FALSE(test_impl_.no_strip_strings_);
   EXPECT_TRUE(test_impl_.output_metadata_);
   EXPECT_FALSE(test_impl_.overwrite_);
+  EXPECT_FALSE(test_impl_.parallel_relink_);
   EXPECT_FALSE(test_impl_.fuzz_);
 
   EXPECT_FALSE(test_impl_.SetUp());
@@ -252,9 +259,12 @@ TEST_F(RelinkAppTest, ParseFullCommandLineWithOrderFile) {
   cmd_line_.AppendSwitchPath("order-file", order_file_path_);
   cmd_line_.AppendSwitch("no-augment-pdb");
   cmd_line_.AppendSwitch("compress-pdb");
+  cmd_line_.AppendSwitch("incremental-pdb");
   cmd_line_.AppendSwitch("no-strip-strings");
   cmd_line_.AppendSwitch("no-metadata");
   cmd_line_.AppendSwitch("overwrite");
+  cmd_line_.AppendSwitch("parallel-relink");
+  cmd_line_.AppendSwitchPath("profile-output", profile_output_path_);
   cmd_line_.AppendSwitch("fuzz");
 
   EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
@@ -263,14 +273,17 @@ TEST_F(RelinkAppTest, ParseFullCommandLineWithOrderFile) {
   EXPECT_EQ(output_image_path_, test_impl_.output_image_path_);
   EXPECT_EQ(output_pdb_path_, test_impl_.output_pdb_path_);
   EXPECT_EQ(order_file_path_, test_impl_.order_file_path_);
+  EXPECT_EQ(profile_output_path_, test_impl_.profile_output_path_);
   EXPECT_EQ(0, test_impl_.seed_);
   EXPECT_EQ(0, test_impl_.padding_);
   EXPECT_EQ(1, test_impl_.code_alignment_);
   EXPECT_TRUE(test_impl_.no_augment_pdb_);
   EXPECT_TRUE(test_impl_.compress_pdb_);
+  EXPECT_TRUE(test_impl_.incremental_pdb_);
   EXPECT_TRUE(test_impl_.no_strip_strings_);
   EXPECT_FALSE(test_impl_.output_metadata_);
   EXPECT_TRUE(test_impl_.overwrite_);
+  EXPECT_TRUE(test_impl_.parallel_relink_);
   EXPECT_TRUE(test_impl_.fuzz_);
 
   // The order file doesn't actually exist, so setup should fail to infer the
@@ -293,6 +306,7 @@ TEST_F(RelinkAppTest, ParseFullCommandLineWithInputSeedAndMetadata) {
   cmd_line_.AppendSwitch("compress-pdb");
   cmd_line_.AppendSwitch("no-strip-strings");
   cmd_line_.AppendSwitch("overwrite");
+  cmd_line_.AppendSwitch("parallel-relink");
   cmd_line_.AppendSwitch("fuzz");
 
   EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
@@ -309,6 +323,7 @@ TEST_F(RelinkAppTest, ParseFullCommandLineWithInputSeedAndMetadata) {
   EXPECT_TRUE(test_impl_.no_strip_strings_);
   EXPECT_TRUE(test_impl_.output_metadata_);
   EXPECT_TRUE(test_impl_.overwrite_);
+  EXPECT_TRUE(test_impl_.parallel_relink_);
   EXPECT_TRUE(test_impl_.fuzz_);
 
   // SetUp() has nothing else to infer so it should succeed.
@@ -346,6 +361,7 @@ TEST_F(RelinkAppTest, RandomRelink) {
   cmd_line_.AppendSwitchASCII("seed", base::StringPrintf("%d", seed_));
   cmd_line_.AppendSwitchASCII("padding", base::StringPrintf("%d", padding_));
   cmd_line_.AppendSwitch("overwrite");
+  cmd_line_.AppendSwitch("parallel-relink");
 
   ASSERT_EQ(0, test_app_.Run());
   ASSERT_NO_FATAL_FAILURE(CheckTestDll(output_image_path_));
@@ -359,6 +375,7 @@ TEST_F(RelinkAppTest, RandomRelinkBasicBlocks) {
   cmd_line_.AppendSwitchASCII("seed", base::StringPrintf("%d", seed_));
   cmd_line_.AppendSwitchASCII("padding", base::StringPrintf("%d", padding_));
   cmd_line_.AppendSwitch("overwrite");
+  cmd_line_.AppendSwitch("parallel-relink");
   cmd_line_.AppendSwitch("basic-blocks");
   cmd_line_.AppendSwitch("exclude-bb-padding");
 
@@ -374,6 +391,7 @@ TEST_F(RelinkAppTest, RandomRelinkBasicBlocksWithFuzzing) {
   cmd_line_.AppendSwitchASCII("seed", base::StringPrintf("%d", seed_));
   cmd_line_.AppendSwitchASCII("padding", base::StringPrintf("%d", padding_));
   cmd_line_.AppendSwitch("overwrite");
+  cmd_line_.AppendSwitch("parallel-relink");
   cmd_line_.AppendSwitch("basic-blocks");
   cmd_line_.AppendSwitch("exclude-bb-padding");
   cmd_line_.AppendSwitch("fuzz");
@@ -18,6 +18,8 @@
 #include <deque>
 #include <set>
 
+#include "base/memory/scoped_vector.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/basic_block_decomposer.h"
 #include "syzygy/block_graph/basic_block_subgraph.h"
@@ -570,8 +572,51 @@ void BasicBlockOptimizer::BasicBlockOrderer::AddRecursiveDataReferences(
   }
 }
 
+class BasicBlockOptimizer::BlockOptimization
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  BlockOptimization(const BlockGraph::Block* block,
+                    const ImageLayout& image_layout,
+                    const IndexedFrequencyInformation& entry_counts)
+      : block_(block),
+        image_layout_(image_layout),
+        entry_counts_(entry_counts),
+        succeeded_(false) {
+    DCHECK(block != NULL);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  // Optimizes the block. This may be called on a worker thread, while the
+  // image layout and the entry counts are only ever read.
+  virtual void Run() OVERRIDE {
+    succeeded_ = OptimizeBlock(block_, image_layout_, entry_counts_,
+                               &warm_block_specs_, &cold_block_specs_);
+  }
+  // @}
+
+  // @name Accessors.
+  // @{
+  const BlockGraph::Block* block() const { return block_; }
+  bool succeeded() const { return succeeded_; }
+  Order::BlockSpecVector* warm_block_specs() { return &warm_block_specs_; }
+  Order::BlockSpecVector* cold_block_specs() { return &cold_block_specs_; }
+  // @}
+
+ private:
+  const BlockGraph::Block* block_;
+  const ImageLayout& image_layout_;
+  const IndexedFrequencyInformation& entry_counts_;
+  bool succeeded_;
+  Order::BlockSpecVector warm_block_specs_;
+  Order::BlockSpecVector cold_block_specs_;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockOptimization);
+};
+
 BasicBlockOptimizer::BasicBlockOptimizer()
-    : cold_section_name_(kDefaultColdSectionName) {
+    : cold_section_name_(kDefaultColdSectionName),
+      num_threads_(1) {
 }
 
 bool BasicBlockOptimizer::Optimize(
@@ -618,6 +663,7 @@ bool BasicBlockOptimizer::Optimize(
     if (!OptimizeSection(image_layout,
                          entry_counts,
                          explicit_blocks,
+                         num_threads_,
                          section_spec,
                          &warm_block_specs,
                          &cold_block_specs)) {
@@ -731,27 +777,26 @@ bool BasicBlockOptimizer::OptimizeSection(
     const ImageLayout& image_layout,
     const IndexedFrequencyInformation& entry_counts,
     const ConstBlockVector& explicit_blocks,
+    size_t num_threads,
     Order::SectionSpec* orig_section_spec,
     Order::BlockSpecVector* warm_block_specs,
     Order::BlockSpecVector* cold_block_specs) {
+  DCHECK_LT(0U, num_threads);
   DCHECK(orig_section_spec != NULL);
   DCHECK(warm_block_specs != NULL);
   DCHECK(cold_block_specs != NULL);
 
-  // Place all of the explicitly ordered blocks.
+  // Gather the blocks to optimize, starting with the explicitly ordered ones.
+  ScopedVector<BlockOptimization> optimizations;
   for (size_t i = 0; i < orig_section_spec->blocks.size(); ++i) {
     Order::BlockSpec* block_spec = &orig_section_spec->blocks[i];
     DCHECK(block_spec->block != NULL);
     DCHECK(block_spec->basic_block_offsets.empty());
     DCHECK(IsExplicitBlock(explicit_blocks, block_spec->block));
 
-    if (!OptimizeBlock(block_spec->block,
-                       image_layout,
-                       entry_counts,
-                       warm_block_specs,
-                       cold_block_specs)) {
-      return false;
-    }
+    optimizations.push_back(new BlockOptimization(block_spec->block,
+                                                  image_layout,
+                                                  entry_counts));
   }
 
   // If we are updating a preexisting section, then account for the rest of
@@ -775,14 +820,43 @@ bool BasicBlockOptimizer::OptimizeSection(
         continue;
 
       // We apply the same optimization as for explicitly placed blocks.
-      if (!OptimizeBlock(it->second,
-                         image_layout,
-                         entry_counts,
-                         warm_block_specs,
-                         cold_block_specs)) {
-        return false;
-      }
+      optimizations.push_back(new BlockOptimization(it->second,
+                                                    image_layout,
+                                                    entry_counts));
+    }
+  }
+
+  // Optimize the blocks. Each one is decomposed and ordered on its own, so
+  // they may be handled concurrently.
+  size_t num_workers = std::min(num_threads, optimizations.size());
+  if (num_workers > 1) {
+    base::DelegateSimpleThreadPool pool("BasicBlockOptimizer",
+                                        static_cast<int>(num_workers));
+    pool.Start();
+    for (size_t i = 0; i < optimizations.size(); ++i)
+      pool.AddWork(optimizations[i]);
+    pool.JoinAll();
+  } else {
+    for (size_t i = 0; i < optimizations.size(); ++i)
+      optimizations[i]->Run();
+  }
+
+  // Merge the results in block order, so that the outcome does not depend on
+  // the number of threads.
+  for (size_t i = 0; i < optimizations.size(); ++i) {
+    BlockOptimization* optimization = optimizations[i];
+    if (!optimization->succeeded()) {
+      LOG(ERROR) << "Failed to optimize block \""
+                 << optimization->block()->name() << "\".";
+      return false;
     }
+
+    warm_block_specs->insert(warm_block_specs->end(),
+                             optimization->warm_block_specs()->begin(),
+                             optimization->warm_block_specs()->end());
+    cold_block_specs->insert(cold_block_specs->end(),
+                             optimization->cold_block_specs()->begin(),
+                             optimization->cold_block_specs()->end());
   }
 
   return true;
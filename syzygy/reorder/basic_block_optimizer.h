@@ -53,6 +53,20 @@ class BasicBlockOptimizer {
     value.CopyToString(&cold_section_name_);
   }
 
+  // @returns the number of worker threads used to optimize the blocks of a
+  //     section.
+  size_t num_threads() const { return num_threads_; }
+
+  // Sets the number of worker threads used to optimize the blocks of a
+  // section. Each block is decomposed and ordered independently of the others,
+  // and the results are merged in the original block order, so the resulting
+  // ordering does not depend on this value. Defaults to 1.
+  // @param num_threads the number of worker threads to use.
+  void set_num_threads(size_t num_threads) {
+    DCHECK_LT(0U, num_threads);
+    num_threads_ = num_threads;
+  }
+
   // Basic-block optimize the given @p order.
   bool Optimize(const ImageLayout& image_layout,
                 const IndexedFrequencyInformation& entry_counts,
@@ -70,10 +84,12 @@ class BasicBlockOptimizer {
                             Order::BlockSpecVector* cold_block_specs);
 
   // Optimize the layout of all basic-blocks in a section, as defined by the
-  // given @p section_spec and the original @p image_layout.
+  // given @p section_spec and the original @p image_layout. The blocks are
+  // optimized on up to @p num_threads worker threads.
   static bool OptimizeSection(const ImageLayout& image_layout,
                               const IndexedFrequencyInformation& entry_counts,
                               const ConstBlockVector& explicit_blocks,
+                              size_t num_threads,
                               Order::SectionSpec* orig_section_spec,
                               Order::BlockSpecVector* warm_block_specs,
                               Order::BlockSpecVector* cold_block_specs);
@@ -82,7 +98,13 @@ class BasicBlockOptimizer {
   // basic-blocks.
   std::string cold_section_name_;
 
+  // The number of worker threads used to optimize the blocks of a section.
+  size_t num_threads_;
+
  private:
+  // A work item which optimizes a single block, possibly on a worker thread.
+  class BlockOptimization;
+
   DISALLOW_COPY_AND_ASSIGN(BasicBlockOptimizer);
 };
 
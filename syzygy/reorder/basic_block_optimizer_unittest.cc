@@ -361,6 +361,10 @@ TEST_F(BasicBlockOptimizerTest, Accessors) {
   EXPECT_NE(kSectionName, optimizer_.cold_section_name());
   optimizer_.set_cold_section_name(kSectionName);
   EXPECT_EQ(kSectionName, optimizer_.cold_section_name());
+
+  EXPECT_EQ(1U, optimizer_.num_threads());
+  optimizer_.set_num_threads(4);
+  EXPECT_EQ(4U, optimizer_.num_threads());
 }
 
 TEST_F(BasicBlockOptimizerTest, EmptyOrderingAllCold) {
@@ -473,4 +477,49 @@ TEST_F(BasicBlockOptimizerTest, HotCold) {
             order.sections.back().blocks[0].basic_block_offsets.size());
 }
 
+TEST_F(BasicBlockOptimizerTest, ConcurrentMatchesSerial) {
+  // Mark the entry point of every other code block as hot, so that the hot
+  // functions are decomposed and the rest are moved to the cold section.
+  IndexedFrequencyInformation entry_counts;
+  entry_counts.num_entries = 0;
+  entry_counts.num_columns = 1;
+  entry_counts.data_type = ::common::IndexedFrequencyData::BASIC_BLOCK_ENTRY;
+  entry_counts.frequency_size = 4;
+  bool is_hot = true;
+  BlockGraph::AddressSpace::RangeMapConstIter it =
+      image_layout_.blocks.begin();
+  for (; it != image_layout_.blocks.end(); ++it) {
+    if (it->second->type() != BlockGraph::CODE_BLOCK)
+      continue;
+    if (is_hot)
+      entry_counts.frequency_map[std::make_pair(it->first.start().value(),
+                                                0)] = 1;
+    is_hot = !is_hot;
+  }
+
+  Order serial_order;
+  ASSERT_TRUE(
+      optimizer_.Optimize(image_layout_, entry_counts, &serial_order));
+
+  Order concurrent_order;
+  optimizer_.set_num_threads(4);
+  ASSERT_TRUE(
+      optimizer_.Optimize(image_layout_, entry_counts, &concurrent_order));
+
+  // The orderings are identical.
+  ASSERT_EQ(serial_order.sections.size(), concurrent_order.sections.size());
+  for (size_t i = 0; i < serial_order.sections.size(); ++i) {
+    const Order::SectionSpec& serial = serial_order.sections[i];
+    const Order::SectionSpec& concurrent = concurrent_order.sections[i];
+    EXPECT_EQ(serial.id, concurrent.id);
+    EXPECT_EQ(serial.name, concurrent.name);
+    ASSERT_EQ(serial.blocks.size(), concurrent.blocks.size());
+    for (size_t k = 0; k < serial.blocks.size(); ++k) {
+      EXPECT_EQ(serial.blocks[k].block, concurrent.blocks[k].block);
+      EXPECT_EQ(serial.blocks[k].basic_block_offsets,
+                concurrent.blocks[k].basic_block_offsets);
+    }
+  }
+}
+
 }  // namespace reorder
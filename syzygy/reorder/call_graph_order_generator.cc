@@ -0,0 +1,269 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/reorder/call_graph_order_generator.h"
+
+#include <algorithm>
+#include <set>
+
+namespace reorder {
+
+namespace {
+
+typedef block_graph::BlockGraph::Block Block;
+typedef std::pair<uint64, const Block*> WeightedBlock;
+
+// Sorts blocks by decreasing weight, then by increasing address so that the
+// order doesn't depend on where the blocks live in memory.
+struct WeightedBlockSortDecrWeight {
+  bool operator()(const WeightedBlock& wb1, const WeightedBlock& wb2) const {
+    if (wb1.first != wb2.first)
+      return wb1.first > wb2.first;
+    return wb1.second->addr() < wb2.second->addr();
+  }
+};
+
+typedef CallGraphOrderGenerator::Cluster Cluster;
+
+// Sorts clusters by decreasing density, then by increasing first entry time,
+// and finally by the address of their first block.
+struct ClusterSortLayoutOrder {
+  bool operator()(const Cluster* c1, const Cluster* c2) const {
+    // Compare c1->weight / c1->size with c2->weight / c2->size without
+    // dividing. The sizes are kept non-zero by the callers.
+    double density1 = static_cast<double>(c1->weight) * c2->size;
+    double density2 = static_cast<double>(c2->weight) * c1->size;
+    if (density1 != density2)
+      return density1 > density2;
+
+    if (c1->has_first_entry_time != c2->has_first_entry_time)
+      return c1->has_first_entry_time;
+    if (c1->has_first_entry_time &&
+        c1->first_entry_time != c2->first_entry_time) {
+      return c1->first_entry_time < c2->first_entry_time;
+    }
+
+    return c1->blocks.front()->addr() < c2->blocks.front()->addr();
+  }
+};
+
+}  // namespace
+
+// This is the size of a page, which is the granularity at which the image
+// is paged in and at which the i-TLB maps it.
+const size_t CallGraphOrderGenerator::kMaxClusterSize = 4096;
+
+CallGraphOrderGenerator::CallGraphOrderGenerator()
+    : Reorderer::OrderGenerator("Call Graph Order Generator") {
+}
+
+CallGraphOrderGenerator::~CallGraphOrderGenerator() {
+}
+
+bool CallGraphOrderGenerator::OnCodeBlockEntry(const BlockGraph::Block* block,
+                                               RelativeAddress address,
+                                               uint32 process_id,
+                                               uint32 thread_id,
+                                               const UniqueTime& time) {
+  DCHECK(block != NULL);
+
+  // Keep around the earliest entry to each block only.
+  std::pair<BlockTimeMap::iterator, bool> result =
+      first_entry_times_.insert(std::make_pair(block, time));
+  if (!result.second && time < result.first->second)
+    result.first->second = time;
+
+  return true;
+}
+
+bool CallGraphOrderGenerator::OnCallEdge(const BlockGraph::Block* caller,
+                                         const BlockGraph::Block* callee,
+                                         uint32 process_id,
+                                         uint32 thread_id,
+                                         uint64 num_calls) {
+  DCHECK(callee != NULL);
+
+  call_counts_[callee] += num_calls;
+
+  // Calls from outside the module and recursive calls don't bind blocks
+  // together. The caller is still part of the call graph though.
+  if (caller == NULL)
+    return true;
+  call_counts_.insert(std::make_pair(caller, 0));
+  if (caller != callee)
+    callers_[callee][caller] += num_calls;
+
+  return true;
+}
+
+bool CallGraphOrderGenerator::CalculateReordering(const PEFile& pe_file,
+                                                  const ImageLayout& image,
+                                                  bool reorder_code,
+                                                  bool reorder_data,
+                                                  Order* order) {
+  DCHECK(order != NULL);
+
+  LOG(INFO) << "Encountered " << call_counts_.size() << " blocks in the "
+            << "call graph and " << first_entry_times_.size() << " executed "
+            << "blocks.";
+
+  // Initialize the section list and ordering meta data.
+  order->comment = "Call graph clustering ordering";
+  order->sections.clear();
+  order->sections.resize(image.sections.size());
+  for (size_t i = 0; i < image.sections.size(); ++i) {
+    order->sections[i].id = i;
+    order->sections[i].name = image.sections[i].name;
+    order->sections[i].characteristics = image.sections[i].characteristics;
+  }
+
+  // Lay out the clusters at the start of their sections.
+  std::set<const BlockGraph::Block*> inserted_blocks;
+  if (reorder_code) {
+    ClusterVector clusters;
+    BuildClusters(&clusters);
+    for (size_t i = 0; i < clusters.size(); ++i) {
+      const BlockVector& blocks = clusters[i].blocks;
+      for (size_t j = 0; j < blocks.size(); ++j) {
+        // All code blocks should belong to a defined section.
+        DCHECK_NE(pe::kInvalidSection, blocks[j]->section());
+        order->sections[blocks[j]->section()].blocks.push_back(
+            Order::BlockSpec(blocks[j]));
+        inserted_blocks.insert(blocks[j]);
+      }
+    }
+  }
+
+  // Add the remaining blocks in each section to the order.
+  for (size_t section_index = 0; ; ++section_index) {
+    const IMAGE_SECTION_HEADER* section =
+        pe_file.section_header(section_index);
+    if (section == NULL)
+      break;
+
+    RelativeAddress section_start = RelativeAddress(section->VirtualAddress);
+    AddressSpace::RangeMapConstIterPair section_blocks =
+        image.blocks.GetIntersectingBlocks(
+            section_start, section->Misc.VirtualSize);
+    AddressSpace::RangeMapConstIter& section_it = section_blocks.first;
+    const AddressSpace::RangeMapConstIter& section_end = section_blocks.second;
+    for (; section_it != section_end; ++section_it) {
+      BlockGraph::Block* block = section_it->second;
+      if (inserted_blocks.count(block) > 0)
+        continue;
+      order->sections[section_index].blocks.push_back(Order::BlockSpec(block));
+    }
+  }
+
+  return true;
+}
+
+void CallGraphOrderGenerator::BuildClusters(ClusterVector* clusters) const {
+  DCHECK(clusters != NULL);
+
+  // Start out with a cluster per block, visiting the blocks by decreasing
+  // call count. Blocks that were executed but never seen in the call graph
+  // have no calls.
+  std::vector<WeightedBlock> blocks;
+  blocks.reserve(call_counts_.size() + first_entry_times_.size());
+  BlockWeightMap::const_iterator count_it = call_counts_.begin();
+  for (; count_it != call_counts_.end(); ++count_it)
+    blocks.push_back(WeightedBlock(count_it->second, count_it->first));
+  BlockTimeMap::const_iterator time_it = first_entry_times_.begin();
+  for (; time_it != first_entry_times_.end(); ++time_it) {
+    if (call_counts_.find(time_it->first) == call_counts_.end())
+      blocks.push_back(WeightedBlock(0, time_it->first));
+  }
+  std::sort(blocks.begin(), blocks.end(), WeightedBlockSortDecrWeight());
+
+  ClusterVector all_clusters(blocks.size());
+  std::map<const BlockGraph::Block*, size_t> cluster_ids;
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    const BlockGraph::Block* block = blocks[i].second;
+    Cluster& cluster = all_clusters[i];
+    cluster.blocks.push_back(block);
+    // Empty blocks still take up a slot in the ordering.
+    cluster.size = std::max<size_t>(block->size(), 1);
+    cluster.weight = blocks[i].first;
+    time_it = first_entry_times_.find(block);
+    if (time_it != first_entry_times_.end()) {
+      cluster.first_entry_time = time_it->second;
+      cluster.has_first_entry_time = true;
+    }
+    cluster_ids[block] = i;
+  }
+
+  // Append the cluster of each block to that of its most frequent caller.
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    const BlockGraph::Block* callee = blocks[i].second;
+    CallerMap::const_iterator callers_it = callers_.find(callee);
+    if (callers_it == callers_.end())
+      continue;
+
+    // Find the most frequent caller, preferring the lowest address on ties.
+    const BlockGraph::Block* caller = NULL;
+    uint64 caller_weight = 0;
+    BlockWeightMap::const_iterator caller_it = callers_it->second.begin();
+    for (; caller_it != callers_it->second.end(); ++caller_it) {
+      if (caller == NULL || caller_it->second > caller_weight ||
+          (caller_it->second == caller_weight &&
+           caller_it->first->addr() < caller->addr())) {
+        caller = caller_it->first;
+        caller_weight = caller_it->second;
+      }
+    }
+    DCHECK(caller != NULL);
+
+    size_t caller_id = cluster_ids[caller];
+    size_t callee_id = cluster_ids[callee];
+    if (caller_id == callee_id)
+      continue;
+    Cluster& caller_cluster = all_clusters[caller_id];
+    Cluster& callee_cluster = all_clusters[callee_id];
+    if (caller_cluster.size + callee_cluster.size > kMaxClusterSize)
+      continue;
+
+    // Merge the callee's cluster into the caller's.
+    for (size_t j = 0; j < callee_cluster.blocks.size(); ++j)
+      cluster_ids[callee_cluster.blocks[j]] = caller_id;
+    caller_cluster.blocks.insert(caller_cluster.blocks.end(),
+                                 callee_cluster.blocks.begin(),
+                                 callee_cluster.blocks.end());
+    caller_cluster.size += callee_cluster.size;
+    caller_cluster.weight += callee_cluster.weight;
+    if (callee_cluster.has_first_entry_time &&
+        (!caller_cluster.has_first_entry_time ||
+         callee_cluster.first_entry_time < caller_cluster.first_entry_time)) {
+      caller_cluster.first_entry_time = callee_cluster.first_entry_time;
+      caller_cluster.has_first_entry_time = true;
+    }
+    callee_cluster = Cluster();
+  }
+
+  // Sort the surviving clusters into layout order.
+  std::vector<const Cluster*> sorted_clusters;
+  for (size_t i = 0; i < all_clusters.size(); ++i) {
+    if (!all_clusters[i].blocks.empty())
+      sorted_clusters.push_back(&all_clusters[i]);
+  }
+  std::sort(sorted_clusters.begin(), sorted_clusters.end(),
+            ClusterSortLayoutOrder());
+
+  clusters->clear();
+  clusters->reserve(sorted_clusters.size());
+  for (size_t i = 0; i < sorted_clusters.size(); ++i)
+    clusters->push_back(*sorted_clusters[i]);
+}
+
+}  // namespace reorder
@@ -0,0 +1,114 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// An implementation of a Reorderer. The CallGraphOrderGenerator places code
+// blocks using the weighted call graph recorded by the profiler, clustering
+// callers with their hottest callees in the style of Pettis-Hansen and C3
+// ("Optimizing Function Placement for Large-Scale Data-Center Applications").
+//
+// Each code block starts out in a cluster of its own. The blocks are visited
+// in order of decreasing call count, and the cluster of each block is appended
+// to the cluster of its most frequent caller, as long as the merged cluster
+// still fits in a page. This keeps hot call chains on adjacent pages. The
+// clusters are then laid out by decreasing density (calls per byte), so that
+// the hottest code is packed into as few pages as possible, with ties broken
+// by the time the clusters were first executed.
+//
+// Blocks that were executed but not seen in the call graph, which is the case
+// for traces captured without the profiler, are laid out in clusters of their
+// own after the call graph. Data blocks are left in their original order.
+
+#ifndef SYZYGY_REORDER_CALL_GRAPH_ORDER_GENERATOR_H_
+#define SYZYGY_REORDER_CALL_GRAPH_ORDER_GENERATOR_H_
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "syzygy/reorder/reorderer.h"
+
+namespace reorder {
+
+// A call-graph clustering order generator. See comment at top of this header
+// file for more details.
+class CallGraphOrderGenerator : public Reorderer::OrderGenerator {
+ public:
+  // A set of blocks to be laid out contiguously.
+  struct Cluster;
+  typedef std::vector<Cluster> ClusterVector;
+
+  // The maximum size of a cluster of blocks.
+  static const size_t kMaxClusterSize;
+
+  CallGraphOrderGenerator();
+  virtual ~CallGraphOrderGenerator();
+
+  // OrderGenerator implementation.
+  virtual bool OnCodeBlockEntry(const BlockGraph::Block* block,
+                                RelativeAddress address,
+                                uint32 process_id,
+                                uint32 thread_id,
+                                const UniqueTime& time) OVERRIDE;
+  virtual bool OnCallEdge(const BlockGraph::Block* caller,
+                          const BlockGraph::Block* callee,
+                          uint32 process_id,
+                          uint32 thread_id,
+                          uint64 num_calls) OVERRIDE;
+  virtual bool CalculateReordering(const PEFile& pe_file,
+                                   const ImageLayout& image,
+                                   bool reorder_code,
+                                   bool reorder_data,
+                                   Order* order) OVERRIDE;
+
+ protected:
+  typedef std::vector<const BlockGraph::Block*> BlockVector;
+  typedef std::map<const BlockGraph::Block*, uint64> BlockWeightMap;
+  typedef std::map<const BlockGraph::Block*, BlockWeightMap> CallerMap;
+  typedef std::map<const BlockGraph::Block*, UniqueTime> BlockTimeMap;
+
+  // Clusters the blocks seen in the traces.
+  // @param clusters receives the clusters, in layout order.
+  void BuildClusters(ClusterVector* clusters) const;
+
+  // The number of calls made to each block seen in the call graph.
+  BlockWeightMap call_counts_;
+
+  // The weight of the calls made to each block, by calling block.
+  CallerMap callers_;
+
+  // The time at which each block was first executed.
+  BlockTimeMap first_entry_times_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(CallGraphOrderGenerator);
+};
+
+struct CallGraphOrderGenerator::Cluster {
+  Cluster() : size(0), weight(0), has_first_entry_time(false) {}
+
+  // The blocks in the cluster, in layout order.
+  BlockVector blocks;
+  // The total size of the blocks.
+  size_t size;
+  // The total number of calls made to the blocks.
+  uint64 weight;
+  // The earliest time at which a block of the cluster was executed, if any
+  // was seen by OnCodeBlockEntry.
+  UniqueTime first_entry_time;
+  bool has_first_entry_time;
+};
+
+}  // namespace reorder
+
+#endif  // SYZYGY_REORDER_CALL_GRAPH_ORDER_GENERATOR_H_
@@ -0,0 +1,130 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/reorder/call_graph_order_generator.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/reorder/order_generator_test.h"
+
+namespace reorder {
+
+namespace {
+
+typedef block_graph::BlockGraph BlockGraph;
+typedef BlockGraph::AddressSpace AddressSpace;
+
+class CallGraphOrderGeneratorTest : public testing::OrderGeneratorTest {
+ protected:
+  // Gets the first few non-empty code blocks of the .text section that are
+  // small enough to be clustered together.
+  void GetSmallCodeBlocks(size_t count,
+                          size_t* section_index,
+                          block_graph::ConstBlockVector* blocks) {
+    ASSERT_TRUE(section_index != NULL);
+    ASSERT_TRUE(blocks != NULL);
+
+    *section_index = input_dll_.GetSectionIndex(".text");
+    const IMAGE_SECTION_HEADER* section =
+        input_dll_.section_header(*section_index);
+    ASSERT_TRUE(section != NULL);
+
+    AddressSpace::RangeMapConstIterPair section_blocks =
+        image_layout_.blocks.GetIntersectingBlocks(
+            core::RelativeAddress(section->VirtualAddress),
+            section->Misc.VirtualSize);
+    AddressSpace::RangeMapConstIter it = section_blocks.first;
+    size_t max_size = CallGraphOrderGenerator::kMaxClusterSize / (2 * count);
+    for (; it != section_blocks.second && blocks->size() < count; ++it) {
+      const BlockGraph::Block* block = it->second;
+      if (block->type() == BlockGraph::CODE_BLOCK && block->size() > 0 &&
+          block->size() <= max_size) {
+        blocks->push_back(block);
+      }
+    }
+    ASSERT_EQ(count, blocks->size());
+  }
+
+  CallGraphOrderGenerator order_generator_;
+};
+
+}  // namespace
+
+TEST_F(CallGraphOrderGeneratorTest, DoNotReorder) {
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   false,
+                                                   false,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+
+  // Verify that the order found in order_ matches the original decomposed
+  // image.
+  for (size_t i = 0; i != order_.sections.size(); ++i) {
+    const IMAGE_SECTION_HEADER* section = input_dll_.section_header(i);
+    ExpectSameOrder(section, order_.sections[i].blocks);
+  }
+}
+
+TEST_F(CallGraphOrderGeneratorTest, ReorderCode) {
+  size_t section_index = 0;
+  block_graph::ConstBlockVector blocks;
+  ASSERT_NO_FATAL_FAILURE(GetSmallCodeBlocks(6, &section_index, &blocks));
+
+  // A hot call chain entered from outside of the module: 0 -> 1 -> 2. The
+  // chain is also entered recursively, which must not affect clustering.
+  order_generator_.OnCallEdge(NULL, blocks[0], 1, 1, 1000);
+  order_generator_.OnCallEdge(blocks[0], blocks[1], 1, 1, 900);
+  order_generator_.OnCallEdge(blocks[1], blocks[2], 1, 1, 800);
+  order_generator_.OnCallEdge(blocks[2], blocks[2], 1, 1, 10);
+  // A cold call from 5 to 3, and a colder call from 4 to 3 on another thread.
+  order_generator_.OnCallEdge(blocks[5], blocks[3], 1, 2, 2);
+  order_generator_.OnCallEdge(blocks[4], blocks[3], 1, 2, 1);
+
+  // Blocks 4 and 5 were executed, but never called.
+  order_generator_.OnCodeBlockEntry(
+      blocks[4], blocks[4]->addr(), 1, 2, GetSystemTime());
+  order_generator_.OnCodeBlockEntry(
+      blocks[5], blocks[5]->addr(), 1, 2, GetSystemTime());
+
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   true,
+                                                   false,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+
+  // Expected ordering: the hot chain, then the cold cluster, then the block
+  // that was only executed.
+  const Reorderer::Order::BlockSpecVector& block_specs =
+      order_.sections[section_index].blocks;
+  ASSERT_LE(blocks.size(), block_specs.size());
+  EXPECT_EQ(blocks[0], block_specs[0].block);
+  EXPECT_EQ(blocks[1], block_specs[1].block);
+  EXPECT_EQ(blocks[2], block_specs[2].block);
+  EXPECT_EQ(blocks[5], block_specs[3].block);
+  EXPECT_EQ(blocks[3], block_specs[4].block);
+  EXPECT_EQ(blocks[4], block_specs[5].block);
+
+  // Verify that data sections have not been reordered.
+  for (size_t i = 0; i != order_.sections.size(); ++i) {
+    const IMAGE_SECTION_HEADER* section = input_dll_.section_header(i);
+    if ((section->Characteristics & IMAGE_SCN_CNT_CODE) == 0)
+      ExpectSameOrder(section, order_.sections[i].blocks);
+  }
+}
+
+}  // namespace reorder
@@ -43,6 +43,8 @@ struct AverageBlockCall {
   size_t call_count;
   // This is only meaningful if call_count == 1.
   uint32_t process_group_id;
+  // The rank of the most important scenario in which this block was seen.
+  size_t scenario_rank;
 
   double AverageOrder() const {
     DCHECK_LT(0U, call_count);
@@ -50,12 +52,15 @@ struct AverageBlockCall {
   }
 };
 
-// Sorts by decreasing call count. Anything with more than one call count
-// is sorted with a secondary key of increasing order. Anything with a single
-// call count has a secondary key of process_group_id, and a tertiary key of
-// increasing order.
+// Sorts by increasing scenario rank, then by decreasing call count. Anything
+// with more than one call count is sorted with a secondary key of increasing
+// order. Anything with a single call count has a secondary key of
+// process_group_id, and a tertiary key of increasing order.
 struct AverageBlockCallSort {
   bool operator()(const AverageBlockCall& abc1, const AverageBlockCall& abc2) {
+    if (abc1.scenario_rank != abc2.scenario_rank)
+      return abc1.scenario_rank < abc2.scenario_rank;
+
     if (abc1.call_count != abc2.call_count)
       return abc1.call_count > abc2.call_count;
 
@@ -66,6 +71,21 @@ struct AverageBlockCallSort {
   }
 };
 
+// Sorts scenario indices by decreasing weight.
+class ScenarioSortDecrWeight {
+ public:
+  explicit ScenarioSortDecrWeight(const std::vector<double>& weights)
+      : weights_(weights) {
+  }
+
+  bool operator()(size_t s1, size_t s2) const {
+    return weights_[s1] > weights_[s2];
+  }
+
+ private:
+  const std::vector<double>& weights_;
+};
+
 // Extract the values of a map to a vector.
 template<typename K, typename V> void MapToVector(const std::map<K, V>& map,
                                                   std::vector<V>* vector) {
@@ -88,6 +108,18 @@ LinearOrderGenerator::LinearOrderGenerator()
 LinearOrderGenerator::~LinearOrderGenerator() {
 }
 
+bool LinearOrderGenerator::OnScenarioStarted(
+    const playback::Scenario& scenario) {
+  // Close the last process group of the previous scenario. Processes that
+  // outlived the traces of a scenario don't carry over to the next one.
+  if (!CloseProcessGroup())
+    return false;
+  active_process_count_ = 0;
+
+  scenario_weights_.push_back(scenario.weight);
+  return true;
+}
+
 bool LinearOrderGenerator::OnProcessStarted(uint32 process_id,
                                             const UniqueTime& time) {
   if (active_process_count_ == 0) {
@@ -115,6 +147,15 @@ bool LinearOrderGenerator::OnCodeBlockEntry(const BlockGraph::Block* block,
   return TouchBlock(BlockCall(block, process_id, thread_id, time));
 }
 
+bool LinearOrderGenerator::OnDataBlockTouch(const BlockGraph::Block* block,
+                                            uint32 process_id,
+                                            const UniqueTime& time) {
+  // Data blocks outside of the sections of the image can't be ordered.
+  if (block->section() == pe::kInvalidSection)
+    return true;
+  return TouchBlock(BlockCall(block, process_id, 0, time));
+}
+
 bool LinearOrderGenerator::CalculateReordering(const PEFile& pe_file,
                                                const ImageLayout& image,
                                                bool reorder_code,
@@ -129,18 +170,62 @@ bool LinearOrderGenerator::CalculateReordering(const PEFile& pe_file,
   LOG(INFO) << "Encountered " << process_group_calls_.size()
             << " process groups.";
 
-  // Aggregate the block calls.
-  std::map<const BlockGraph::Block*, AverageBlockCall> average_block_call_map;
+  // Rank the scenarios by decreasing weight. Without scenarios, all of the
+  // process groups share the same rank.
+  std::vector<size_t> scenario_ranks(scenario_weights_.size());
+  if (!scenario_weights_.empty()) {
+    std::vector<size_t> scenarios(scenario_weights_.size());
+    for (size_t i = 0; i < scenarios.size(); ++i)
+      scenarios[i] = i;
+    std::stable_sort(scenarios.begin(), scenarios.end(),
+                     ScenarioSortDecrWeight(scenario_weights_));
+    for (size_t i = 0; i < scenarios.size(); ++i)
+      scenario_ranks[scenarios[i]] = i;
+  }
+  std::map<size_t, size_t> process_group_ranks;
   ProcessGroupBlockCalls::const_iterator it = process_group_calls_.begin();
   for (; it != process_group_calls_.end(); ++it) {
+    size_t rank = 0;
+    if (!scenario_ranks.empty()) {
+      ProcessGroupScenarioMap::const_iterator scenario_it =
+          process_group_scenarios_.find(it->first);
+      DCHECK(scenario_it != process_group_scenarios_.end());
+      rank = scenario_ranks[scenario_it->second];
+    }
+    process_group_ranks[it->first] = rank;
+  }
+
+  // Find the most important scenario in which each block was seen.
+  std::map<const BlockGraph::Block*, size_t> block_ranks;
+  for (it = process_group_calls_.begin(); it != process_group_calls_.end();
+       ++it) {
+    size_t rank = process_group_ranks[it->first];
+    for (size_t i = 0; i < it->second.size(); ++i) {
+      std::pair<std::map<const BlockGraph::Block*, size_t>::iterator, bool>
+          result = block_ranks.insert(
+              std::make_pair(it->second[i].block, rank));
+      if (!result.second && rank < result.first->second)
+        result.first->second = rank;
+    }
+  }
+
+  // Aggregate the block calls, only considering the runs of the most
+  // important scenario in which each block was seen.
+  std::map<const BlockGraph::Block*, AverageBlockCall> average_block_call_map;
+  for (it = process_group_calls_.begin(); it != process_group_calls_.end();
+       ++it) {
+    size_t rank = process_group_ranks[it->first];
     for (size_t i = 0; i < it->second.size(); ++i) {
       const BlockCall& block_call = it->second[i];
+      if (block_ranks[block_call.block] != rank)
+        continue;
       AverageBlockCall& average_block_call =
           average_block_call_map[block_call.block];
       average_block_call.block = block_call.block;
       average_block_call.sum_order += i;
       ++average_block_call.call_count;
       average_block_call.process_group_id = it->first;
+      average_block_call.scenario_rank = rank;
     }
   }
 
@@ -165,19 +250,26 @@ bool LinearOrderGenerator::CalculateReordering(const PEFile& pe_file,
     order->sections[i].characteristics = image.sections[i].characteristics;
   }
 
-  // Create the ordering from this list.
+  // Create the ordering from this list. The data blocks seen in the list were
+  // actually touched, so they go ahead of the data blocks that are only
+  // referred to by code.
   BlockSet inserted_blocks;
   for (size_t i = 0; i < average_block_calls.size(); ++i) {
-    const BlockGraph::Block* code_block = average_block_calls[i].block;
-
-    if (reorder_code) {
-      order->sections[code_block->section()].blocks.push_back(
-         Order::BlockSpec(code_block));
-      inserted_blocks.insert(code_block);
+    const BlockGraph::Block* block = average_block_calls[i].block;
+    bool is_code = block->type() == BlockGraph::CODE_BLOCK;
+    if (is_code ? reorder_code : reorder_data) {
+      order->sections[block->section()].blocks.push_back(
+         Order::BlockSpec(block));
+      inserted_blocks.insert(block);
     }
+  }
 
-    // Create an analogous data ordering if we were asked to.
-    if (reorder_data) {
+  // Create an analogous data ordering if we were asked to.
+  if (reorder_data) {
+    for (size_t i = 0; i < average_block_calls.size(); ++i) {
+      const BlockGraph::Block* code_block = average_block_calls[i].block;
+      if (code_block->type() != BlockGraph::CODE_BLOCK)
+        continue;
       if (!InsertDataBlocks(kDataRecursionDepth, code_block, order,
                             &inserted_blocks))
         return false;
@@ -210,7 +302,7 @@ bool LinearOrderGenerator::CalculateReordering(const PEFile& pe_file,
 
 bool LinearOrderGenerator::TouchBlock(const BlockCall& block_call) {
   DCHECK(block_call.block != NULL);
-  // All code blocks should belong to a defined section.
+  // All touched blocks should belong to a defined section.
   DCHECK_NE(pe::kInvalidSection, block_call.block->section());
 
   // Store the block along with the earliest time it was called.
@@ -285,6 +377,10 @@ bool LinearOrderGenerator::CloseProcessGroup() {
     return true;
 
   BlockCalls& block_calls = process_group_calls_[next_process_group_id_];
+  if (!scenario_weights_.empty()) {
+    process_group_scenarios_[next_process_group_id_] =
+        scenario_weights_.size() - 1;
+  }
   ++next_process_group_id_;
 
   MapToVector(block_call_map_, &block_calls);
@@ -17,6 +17,9 @@
 // If data ordering is enabled, all data blocks referred to by a code block
 // are assumed to have been touched when the code block was executed, and they
 // are output in that order.
+// If the traces also hold the data pages touched by the module, the data
+// blocks on those pages are considered hot: they are ordered like code blocks
+// and placed ahead of the data blocks that are only referred to by code.
 //
 // If multiple runs of the instrumented binary are seen in the trace files, each
 // run will be processed independently, and for each unique block, the count of
@@ -35,6 +38,12 @@
 // In the case where there is a single run of the instrumented binary, the
 // ordering will be a simple ordering of blocks by order of execution, as per
 // our original proof-of-concept ordering.
+//
+// When the traces are grouped in scenarios, the scenarios are laid out by
+// decreasing weight: the blocks seen in the most important scenario come
+// first, ordered as above using the runs of that scenario only, followed by
+// the blocks first seen in the next most important scenario, and so on.
+// Scenarios of equal weight are laid out in the order they were processed.
 
 #ifndef SYZYGY_REORDER_LINEAR_ORDER_GENERATOR_H_
 #define SYZYGY_REORDER_LINEAR_ORDER_GENERATOR_H_
@@ -57,6 +66,7 @@ class LinearOrderGenerator : public Reorderer::OrderGenerator {
   virtual ~LinearOrderGenerator();
 
   // OrderGenerator implementation.
+  virtual bool OnScenarioStarted(const playback::Scenario& scenario) OVERRIDE;
   virtual bool OnProcessStarted(uint32 process_id,
                                 const UniqueTime& time) OVERRIDE;
   virtual bool OnProcessEnded(uint32 process_id,
@@ -66,6 +76,9 @@ class LinearOrderGenerator : public Reorderer::OrderGenerator {
                                 uint32 process_id,
                                 uint32 thread_id,
                                 const UniqueTime& time) OVERRIDE;
+  virtual bool OnDataBlockTouch(const BlockGraph::Block* block,
+                                uint32 process_id,
+                                const UniqueTime& time) OVERRIDE;
   virtual bool CalculateReordering(const PEFile& pe_file,
                                    const ImageLayout& image,
                                    bool reorder_code,
@@ -77,8 +90,9 @@ class LinearOrderGenerator : public Reorderer::OrderGenerator {
   typedef std::map<size_t, BlockCalls> ProcessGroupBlockCalls;
   typedef std::map<const BlockGraph::Block*, BlockCall> BlockCallMap;
   typedef std::set<const BlockGraph::Block*> BlockSet;
+  typedef std::map<size_t, size_t> ProcessGroupScenarioMap;
 
-  // Called by OnFunctionEntry to update block_calls_.
+  // Called by OnCodeBlockEntry and OnDataBlockTouch to update block_calls_.
   bool TouchBlock(const BlockCall& block_call);
 
   // Given a block, inserts the data blocks associated with it into
@@ -106,6 +120,13 @@ class LinearOrderGenerator : public Reorderer::OrderGenerator {
   // Stores the linearized block list per process group.
   ProcessGroupBlockCalls process_group_calls_;
 
+  // The weight of each scenario seen so far, by order of appearance. This is
+  // empty if the traces aren't grouped in scenarios.
+  std::vector<double> scenario_weights_;
+
+  // Stores the index of the scenario of each process group.
+  ProcessGroupScenarioMap process_group_scenarios_;
+
   // Stores pointers to blocks, and the first time at which they were accessed.
   // There is one of these per 'process group'.
   BlockCallMap block_call_map_;
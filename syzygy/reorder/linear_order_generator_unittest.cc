@@ -26,6 +26,8 @@ namespace reorder {
 
 namespace {
 
+typedef block_graph::BlockGraph::AddressSpace AddressSpace;
+
 class LinearOrderGeneratorTest : public testing::OrderGeneratorTest {
  protected:
   void ExpectLinearOrder(
@@ -155,4 +157,121 @@ TEST_F(LinearOrderGeneratorTest, ReorderCode) {
   }
 }
 
+TEST_F(LinearOrderGeneratorTest, ReorderCodeByScenario) {
+  core::RandomNumberGenerator random(12345);
+
+  // Get the .text code section.
+  size_t section_index = input_dll_.GetSectionIndex(".text");
+  const IMAGE_SECTION_HEADER* section =
+      input_dll_.section_header(section_index);
+  ASSERT_TRUE(section != NULL);
+
+  // Get 3 random blocks.
+  std::vector<core::RelativeAddress> addrs;
+  block_graph::ConstBlockVector blocks;
+  std::set<const block_graph::BlockGraph::Block*> block_set;
+  while (blocks.size() < 3) {
+    core::RelativeAddress addr(
+        section->VirtualAddress + random(section->Misc.VirtualSize));
+    const block_graph::BlockGraph::Block* block =
+        image_layout_.blocks.GetBlockByAddress(addr);
+    if (!block_set.insert(block).second)
+      continue;
+    addrs.push_back(addr);
+    blocks.push_back(block);
+  }
+
+  // The less important scenario is processed first.
+  // Expected idle calls: block0, block1.
+  playback::Scenario idle;
+  idle.name = "idle";
+  idle.weight = 1.0;
+  EXPECT_TRUE(order_generator_.OnScenarioStarted(idle));
+  order_generator_.OnProcessStarted(1, GetSystemTime());
+  order_generator_.OnCodeBlockEntry(blocks[0], addrs[0], 1, 1, GetSystemTime());
+  order_generator_.OnCodeBlockEntry(blocks[1], addrs[1], 1, 1, GetSystemTime());
+  order_generator_.OnProcessEnded(1, GetSystemTime());
+
+  // Expected startup calls: block2, block1.
+  playback::Scenario startup;
+  startup.name = "startup";
+  startup.weight = 3.0;
+  EXPECT_TRUE(order_generator_.OnScenarioStarted(startup));
+  order_generator_.OnProcessStarted(2, GetSystemTime());
+  order_generator_.OnCodeBlockEntry(blocks[2], addrs[2], 2, 1, GetSystemTime());
+  order_generator_.OnCodeBlockEntry(blocks[1], addrs[1], 2, 1, GetSystemTime());
+  order_generator_.OnProcessEnded(2, GetSystemTime());
+
+  // Expected ordering: the startup blocks, then the remaining idle block.
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   true,
+                                                   false,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+
+  const Reorderer::Order::BlockSpecVector& block_specs =
+      order_.sections[section_index].blocks;
+  ASSERT_LE(3U, block_specs.size());
+  EXPECT_EQ(blocks[2], block_specs[0].block);
+  EXPECT_EQ(blocks[1], block_specs[1].block);
+  EXPECT_EQ(blocks[0], block_specs[2].block);
+
+  // The remaining blocks should be in linear order.
+  ExpectLinearOrder(block_specs.begin() + 3, block_specs.end());
+}
+
+TEST_F(LinearOrderGeneratorTest, ReorderTouchedData) {
+  // Get the .data section.
+  size_t section_index = input_dll_.GetSectionIndex(".data");
+  const IMAGE_SECTION_HEADER* section =
+      input_dll_.section_header(section_index);
+  ASSERT_TRUE(section != NULL);
+
+  // Get its first 3 data blocks.
+  block_graph::ConstBlockVector blocks;
+  AddressSpace::RangeMapConstIterPair section_blocks =
+      image_layout_.blocks.GetIntersectingBlocks(
+          core::RelativeAddress(section->VirtualAddress),
+          section->Misc.VirtualSize);
+  AddressSpace::RangeMapConstIter it = section_blocks.first;
+  for (; it != section_blocks.second && blocks.size() < 3; ++it) {
+    if (it->second->type() == block_graph::BlockGraph::DATA_BLOCK)
+      blocks.push_back(it->second);
+  }
+  ASSERT_EQ(3U, blocks.size());
+
+  // Expected touches: block2, block0, block1.
+  order_generator_.OnProcessStarted(1, GetSystemTime());
+  order_generator_.OnDataBlockTouch(blocks[2], 1, GetSystemTime());
+  order_generator_.OnDataBlockTouch(blocks[0], 1, GetSystemTime());
+  order_generator_.OnDataBlockTouch(blocks[1], 1, GetSystemTime());
+  order_generator_.OnDataBlockTouch(blocks[2], 1, GetSystemTime());
+  order_generator_.OnProcessEnded(1, GetSystemTime());
+
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   false,
+                                                   true,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+
+  // The touched blocks come first, in the order they were first touched.
+  const Reorderer::Order::BlockSpecVector& block_specs =
+      order_.sections[section_index].blocks;
+  ASSERT_LE(3U, block_specs.size());
+  EXPECT_EQ(blocks[2], block_specs[0].block);
+  EXPECT_EQ(blocks[0], block_specs[1].block);
+  EXPECT_EQ(blocks[1], block_specs[2].block);
+
+  // Verify that code sections have not been reordered.
+  for (size_t i = 0; i != order_.sections.size(); ++i) {
+    const IMAGE_SECTION_HEADER* other_section = input_dll_.section_header(i);
+    if ((other_section->Characteristics & IMAGE_SCN_CNT_CODE) != 0)
+      ExpectSameOrder(other_section, order_.sections[i].blocks);
+  }
+}
+
 }  // namespace reorder
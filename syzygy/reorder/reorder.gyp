@@ -23,6 +23,8 @@
       'sources': [
         'basic_block_optimizer.cc',
         'basic_block_optimizer.h',
+        'call_graph_order_generator.cc',
+        'call_graph_order_generator.h',
         'dead_code_finder.cc',
         'dead_code_finder.h',
         'linear_order_generator.cc',
@@ -42,6 +44,7 @@
         '<(src)/sawbuck/log_lib/log_lib.gyp:log_lib',
         '<(src)/syzygy/trace/parse/parse.gyp:parse_lib',
         '<(src)/syzygy/common/common.gyp:common_lib',
+        '<(src)/syzygy/common/common.gyp:stage_profiler_lib',
         '<(src)/syzygy/grinder/grinder.gyp:grinder_lib',
         '<(src)/syzygy/pdb/pdb.gyp:pdb_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
@@ -77,6 +80,7 @@
       'type': 'executable',
       'sources': [
         'basic_block_optimizer_unittest.cc',
+        'call_graph_order_generator_unittest.cc',
         'dead_code_finder_unittest.cc',
         'linear_order_generator_unittest.cc',
         'order_generator_test.cc',
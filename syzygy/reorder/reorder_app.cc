@@ -22,10 +22,12 @@
 #include "base/string_number_conversions.h"
 #include "base/stringprintf.h"
 #include "base/strings/string_split.h"
+#include "syzygy/common/stage_profiler.h"
 #include "syzygy/grinder/basic_block_util.h"
 #include "syzygy/grinder/indexed_frequency_data_serializer.h"
 #include "syzygy/pe/find.h"
 #include "syzygy/reorder/basic_block_optimizer.h"
+#include "syzygy/reorder/call_graph_order_generator.h"
 #include "syzygy/reorder/dead_code_finder.h"
 #include "syzygy/reorder/linear_order_generator.h"
 #include "syzygy/reorder/random_order_generator.h"
@@ -51,13 +53,22 @@ static const char kUsageFormatStr[] =
     "    --input-image=<path> the input image file to reorder. If this is not\n"
     "        specified it will be inferred from the instrumented image's\n"
     "        metadata.\n"
-    "    --basic-block-entry-counts=PATH the path to the JSON file containing\n"
-    "        the summary basic-block entry counts for the image. If this is\n"
-    "        given then the input image is also required.\n"
+    "    --basic-block-entry-counts=PATH the path to the JSON or binary file\n"
+    "        containing the summary basic-block entry counts for the image. If\n"
+    "        this is given then the input image is also required.\n"
+    "    --basic-block-threads=INT the number of threads on which to\n"
+    "        basic-block optimize the ordering. Defaults to 1.\n"
     "    --seed=INT generates a random ordering; don't specify ETW log files.\n"
     "    --list-dead-code instead of an ordering, output the set of functions\n"
     "        not visited during the trace.\n"
+    "    --call-graph clusters callers with their hottest callees using the\n"
+    "        call graph recorded in profiler traces.\n"
+    "    --scenarios=PATH the path to a JSON file grouping the trace files in\n"
+    "        weighted scenarios; don't specify log files. The blocks of the\n"
+    "        most important scenarios are laid out first.\n"
     "    --pretty-print enables pretty printing of the JSON output file.\n"
+    "    --profile-output=PATH writes the time spent in, and the memory used\n"
+    "        by, each stage of the reorderer to this JSON file.\n"
     "    --reorderer-flags=<comma separated reorderer flags>\n"
     "  Reorderer Flags:\n"
     "    no-code: Do not reorder code sections.\n"
@@ -105,9 +116,13 @@ const char ReorderApp::kInstrumentedImage[] = "instrumented-image";
 const char ReorderApp::kOutputFile[] = "output-file";
 const char ReorderApp::kInputImage[] = "input-image";
 const char ReorderApp::kBasicBlockEntryCounts[] = "basic-block-entry-counts";
+const char ReorderApp::kBasicBlockThreads[] = "basic-block-threads";
 const char ReorderApp::kSeed[] = "seed";
 const char ReorderApp::kListDeadCode[] = "list-dead-code";
+const char ReorderApp::kCallGraph[] = "call-graph";
+const char ReorderApp::kScenarios[] = "scenarios";
 const char ReorderApp::kPrettyPrint[] = "pretty-print";
+const char ReorderApp::kProfileOutput[] = "profile-output";
 const char ReorderApp::kReordererFlags[] = "reorderer-flags";
 const char ReorderApp::kInstrumentedDll[] = "instrumented-dll";
 const char ReorderApp::kInputDll[] = "input-dll";
@@ -115,6 +130,7 @@ const char ReorderApp::kInputDll[] = "input-dll";
 ReorderApp::ReorderApp()
     : AppImplBase("Reorder"),
       mode_(kInvalidMode),
+      bb_threads_(1),
       seed_(0),
       pretty_print_(false),
       flags_(0) {
@@ -151,6 +167,15 @@ bool ReorderApp::ParseCommandLine(const CommandLine* command_line) {
 
   bb_entry_count_file_path_ =
       command_line->GetSwitchValuePath(kBasicBlockEntryCounts);
+  scenario_file_path_ = command_line->GetSwitchValuePath(kScenarios);
+
+  // Parse the (optional) number of basic-block optimization threads.
+  if (command_line->HasSwitch(kBasicBlockThreads)) {
+    std::string threads_str(
+        command_line->GetSwitchValueASCII(kBasicBlockThreads));
+    if (!base::StringToSizeT(threads_str, &bb_threads_) || bb_threads_ == 0)
+      return Usage(command_line, "Invalid basic-block threads value.");
+  }
 
   // Parse the reorderer flags.
   std::string flags_str(command_line->GetSwitchValueASCII(kReordererFlags));
@@ -161,11 +186,15 @@ bool ReorderApp::ParseCommandLine(const CommandLine* command_line) {
   // Parse the pretty-print switch.
   pretty_print_ = command_line->HasSwitch(kPrettyPrint);
 
+  profile_output_path_ = command_line->GetSwitchValuePath(kProfileOutput);
+
   // Make all of the input paths absolute.
   input_image_path_ = AbsolutePath(input_image_path_);
   instrumented_image_path_ = AbsolutePath(instrumented_image_path_);
+  profile_output_path_ = AbsolutePath(profile_output_path_);
   output_file_path_ = AbsolutePath(output_file_path_);
   bb_entry_count_file_path_ = AbsolutePath(bb_entry_count_file_path_);
+  scenario_file_path_ = AbsolutePath(scenario_file_path_);
 
   // Capture the (possibly empty) set of trace files to read.
   for (size_t i = 0; i < command_line->GetArgs().size(); ++i) {
@@ -176,9 +205,15 @@ bool ReorderApp::ParseCommandLine(const CommandLine* command_line) {
     }
   }
 
+  // The trace files are either given directly or grouped in scenarios.
+  if (!scenario_file_path_.empty() && !trace_file_paths_.empty()) {
+    return Usage(command_line,
+                 "Trace files are not accepted along with scenarios.");
+  }
+
   // Check if we are in random order mode. Look for and parse --seed.
   if (command_line->HasSwitch(kSeed)) {
-    if (!trace_file_paths_.empty()) {
+    if (!trace_file_paths_.empty() || !scenario_file_path_.empty()) {
       return Usage(command_line,
                    "Trace files are not accepted in random order mode.");
     }
@@ -201,6 +236,16 @@ bool ReorderApp::ParseCommandLine(const CommandLine* command_line) {
     mode_ = kDeadCodeFinderMode;
   }
 
+  // Parse the call-graph switch.
+  if (command_line->HasSwitch(kCallGraph)) {
+    if (mode_ != kInvalidMode) {
+      LOG(ERROR) << "--" << kCallGraph << " is mutually exclusive with --"
+                 << kSeed << "=N and --" << kListDeadCode << ".";
+      return false;
+    }
+    mode_ = kCallGraphOrderMode;
+  }
+
   // If we haven't found anything to over-ride the default mode (linear order),
   // then the default it is.
   if (mode_ == kInvalidMode)
@@ -244,6 +289,10 @@ bool ReorderApp::SetUp() {
     case kDeadCodeFinderMode:
       order_generator_.reset(new DeadCodeFinder());
       return true;
+
+    case kCallGraphOrderMode:
+      order_generator_.reset(new CallGraphOrderGenerator());
+      return true;
   }
 
   NOTREACHED();
@@ -260,6 +309,17 @@ int ReorderApp::Run() {
                       trace_file_paths_,
                       flags_);
 
+  // Load the scenarios, if any.
+  if (!scenario_file_path_.empty()) {
+    Reorderer::ScenarioVector scenarios;
+    if (!playback::LoadScenariosFromJSON(scenario_file_path_, &scenarios)) {
+      LOG(ERROR) << "Unable to load scenarios from \""
+                 << scenario_file_path_.value() << "\".";
+      return 1;
+    }
+    reorderer.set_scenarios(scenarios);
+  }
+
   // Generate a block-level ordering.
   if (!reorderer.Reorder(order_generator_.get(),
                          &order,
@@ -285,6 +345,11 @@ int ReorderApp::Run() {
     return 1;
   }
 
+  if (!profile_output_path_.empty() &&
+      !common::StageProfiler::Instance()->SaveToFile(profile_output_path_)) {
+    return 1;
+  }
+
   // We were successful.
   return 0;
 }
@@ -313,8 +378,7 @@ bool ReorderApp::OptimizeBasicBlocks(const pe::PEFile::Signature& signature,
   // Load the basic-block entry count data.
   ModuleIndexedFrequencyMap module_entry_count_map;
   IndexedFrequencyDataSerializer serializer;
-  if (!serializer.LoadFromJson(bb_entry_count_file_path_,
-                               &module_entry_count_map)) {
+  if (!serializer.Load(bb_entry_count_file_path_, &module_entry_count_map)) {
     LOG(ERROR) << "Failed to load basic-block entry count data";
     return false;
   }
@@ -330,6 +394,7 @@ bool ReorderApp::OptimizeBasicBlocks(const pe::PEFile::Signature& signature,
 
   // Optimize the ordering at the basic-block level.
   BasicBlockOptimizer optimizer;
+  optimizer.set_num_threads(bb_threads_);
   if (!optimizer.Optimize(image_layout, *entry_counts, order)) {
     LOG(ERROR) << "Failed to optimize basic-block ordering.";
     return false;
@@ -46,7 +46,8 @@ class ReorderApp : public common::AppImplBase {
     kInvalidMode,
     kLinearOrderMode,
     kRandomOrderMode,
-    kDeadCodeFinderMode
+    kDeadCodeFinderMode,
+    kCallGraphOrderMode
   };
   // @name Utility members.
   // @{
@@ -66,7 +67,10 @@ class ReorderApp : public common::AppImplBase {
   base::FilePath input_image_path_;
   base::FilePath output_file_path_;
   base::FilePath bb_entry_count_file_path_;
+  base::FilePath scenario_file_path_;
+  base::FilePath profile_output_path_;
   FilePathVector trace_file_paths_;
+  size_t bb_threads_;
   uint32 seed_;
   bool pretty_print_;
   Reorderer::Flags flags_;
@@ -78,9 +82,13 @@ class ReorderApp : public common::AppImplBase {
   static const char kOutputFile[];
   static const char kInputImage[];
   static const char kBasicBlockEntryCounts[];
+  static const char kBasicBlockThreads[];
   static const char kSeed[];
   static const char kListDeadCode[];
+  static const char kCallGraph[];
+  static const char kScenarios[];
   static const char kPrettyPrint[];
+  static const char kProfileOutput[];
   static const char kReordererFlags[];
   static const char kInstrumentedDll[];
   static const char kInputDll[];
@@ -44,12 +44,16 @@ class TestReorderApp : public ReorderApp {
   using ReorderApp::kLinearOrderMode;
   using ReorderApp::kRandomOrderMode;
   using ReorderApp::kDeadCodeFinderMode;
+  using ReorderApp::kCallGraphOrderMode;
   using ReorderApp::mode_;
   using ReorderApp::instrumented_image_path_;
   using ReorderApp::input_image_path_;
   using ReorderApp::output_file_path_;
   using ReorderApp::bb_entry_count_file_path_;
+  using ReorderApp::scenario_file_path_;
+  using ReorderApp::profile_output_path_;
   using ReorderApp::trace_file_paths_;
+  using ReorderApp::bb_threads_;
   using ReorderApp::seed_;
   using ReorderApp::pretty_print_;
   using ReorderApp::flags_;
@@ -57,9 +61,13 @@ class TestReorderApp : public ReorderApp {
   using ReorderApp::kOutputFile;
   using ReorderApp::kInputImage;
   using ReorderApp::kBasicBlockEntryCounts;
+  using ReorderApp::kBasicBlockThreads;
   using ReorderApp::kSeed;
   using ReorderApp::kListDeadCode;
+  using ReorderApp::kCallGraph;
+  using ReorderApp::kScenarios;
   using ReorderApp::kPrettyPrint;
+  using ReorderApp::kProfileOutput;
   using ReorderApp::kReordererFlags;
   using ReorderApp::kInstrumentedDll;
   using ReorderApp::kInputDll;
@@ -104,6 +112,9 @@ class ReorderAppTest : public testing::PELibUnitTest {
     abs_output_file_path_ = testing::GetExeTestDataRelativePath(L"order.json");
     output_file_path_ = testing::GetRelativePath(abs_output_file_path_);
 
+    abs_profile_output_path_ = temp_dir_.Append(L"profile.json");
+    profile_output_path_ = testing::GetRelativePath(abs_profile_output_path_);
+
     abs_bb_entry_count_file_path_ = testing::GetExeTestDataRelativePath(
         L"basic_block_entry_traces\\entry_counts.json");
     bb_entry_count_file_path_ = testing::GetRelativePath(
@@ -142,6 +153,7 @@ class ReorderAppTest : public testing::PELibUnitTest {
   base::FilePath input_image_path_;
   base::FilePath output_file_path_;
   base::FilePath bb_entry_count_file_path_;
+  base::FilePath profile_output_path_;
   base::FilePath trace_file_path_;
   uint32 seed_;
   bool pretty_print_;
@@ -153,6 +165,7 @@ class ReorderAppTest : public testing::PELibUnitTest {
   base::FilePath abs_instrumented_image_path_;
   base::FilePath abs_output_file_path_;
   base::FilePath abs_bb_entry_count_file_path_;
+  base::FilePath abs_profile_output_path_;
   base::FilePath abs_trace_file_path_;
   // @}
 };
@@ -249,9 +262,12 @@ TEST_F(ReorderAppTest, ParseFullLinearOrderCommandLine) {
   cmd_line_.AppendSwitchPath(TestReorderApp::kInputImage, input_image_path_);
   cmd_line_.AppendSwitchPath(
       TestReorderApp::kBasicBlockEntryCounts, bb_entry_count_file_path_);
+  cmd_line_.AppendSwitchASCII(TestReorderApp::kBasicBlockThreads, "4");
   cmd_line_.AppendSwitchASCII(
       TestReorderApp::kReordererFlags, "no-data,no-code");
   cmd_line_.AppendSwitch(TestReorderApp::kPrettyPrint);
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kProfileOutput, profile_output_path_);
   cmd_line_.AppendArgPath(trace_file_path_);
 
   ASSERT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
@@ -262,7 +278,9 @@ TEST_F(ReorderAppTest, ParseFullLinearOrderCommandLine) {
   EXPECT_EQ(abs_output_file_path_, test_impl_.output_file_path_);
   EXPECT_EQ(abs_bb_entry_count_file_path_,
             test_impl_.bb_entry_count_file_path_);
+  EXPECT_EQ(abs_profile_output_path_, test_impl_.profile_output_path_);
   EXPECT_EQ(abs_trace_file_path_, test_impl_.trace_file_paths_.front());
+  EXPECT_EQ(4U, test_impl_.bb_threads_);
   EXPECT_EQ(0U, test_impl_.seed_);
   EXPECT_TRUE(test_impl_.pretty_print_);
   EXPECT_EQ(0, test_impl_.flags_ & Reorderer::kFlagReorderCode);
@@ -271,6 +289,16 @@ TEST_F(ReorderAppTest, ParseFullLinearOrderCommandLine) {
   EXPECT_TRUE(test_impl_.SetUp());
 }
 
+TEST_F(ReorderAppTest, ParseInvalidBasicBlockThreadsFails) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitchASCII(TestReorderApp::kBasicBlockThreads, "0");
+  cmd_line_.AppendArgPath(trace_file_path_);
+
+  EXPECT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(ReorderAppTest, ParseMinimalDeprecatedLinearOrderCommandLine) {
   cmd_line_.AppendSwitchPath(
       TestReorderApp::kInstrumentedDll, instrumented_image_path_);
@@ -362,6 +390,56 @@ TEST_F(ReorderAppTest, ParseDeadCodeFinderCommandLine) {
   EXPECT_TRUE(test_impl_.SetUp());
 }
 
+TEST_F(ReorderAppTest, ParseCallGraphCommandLine) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitch(TestReorderApp::kCallGraph);
+  cmd_line_.AppendArgPath(trace_file_path_);
+
+  ASSERT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+
+  EXPECT_EQ(TestReorderApp::kCallGraphOrderMode, test_impl_.mode_);
+  EXPECT_EQ(abs_instrumented_image_path_, test_impl_.instrumented_image_path_);
+  EXPECT_EQ(abs_output_file_path_, test_impl_.output_file_path_);
+  EXPECT_EQ(abs_trace_file_path_, test_impl_.trace_file_paths_.front());
+
+  EXPECT_TRUE(test_impl_.SetUp());
+}
+
+TEST_F(ReorderAppTest, ParseCallGraphAndListDeadCodeFails) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitch(TestReorderApp::kListDeadCode);
+  cmd_line_.AppendSwitch(TestReorderApp::kCallGraph);
+
+  ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(ReorderAppTest, ParseScenariosCommandLine) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kScenarios, output_file_path_);
+
+  ASSERT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+
+  EXPECT_EQ(TestReorderApp::kLinearOrderMode, test_impl_.mode_);
+  EXPECT_EQ(abs_output_file_path_, test_impl_.scenario_file_path_);
+  EXPECT_TRUE(test_impl_.trace_file_paths_.empty());
+}
+
+TEST_F(ReorderAppTest, ParseScenariosWithTraceFilesFails) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kScenarios, output_file_path_);
+  cmd_line_.AppendArgPath(trace_file_path_);
+
+  ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(ReorderAppTest, LinearOrderEndToEnd) {
   cmd_line_.AppendSwitchPath(
       TestReorderApp::kInstrumentedImage, instrumented_image_path_);
@@ -381,15 +381,20 @@ bool Reorderer::ReorderImpl(Order* order,
   if (!playback_.Init(pe_file, image, &parser_))
     return false;
 
-  if (playback_.trace_files().size() > 0) {
+  if (!scenarios_.empty()) {
+    DCHECK(playback_.trace_files().empty());
+    if (!ConsumeScenarios())
+      return false;
+  } else if (playback_.trace_files().size() > 0) {
     LOG(INFO) << "Processing trace events.";
     if (!parser_.Consume())
       return false;
+  }
 
-    if (code_block_entry_events_ == 0) {
-      LOG(ERROR) << "No events originated from the given instrumented DLL.";
-      return false;
-    }
+  bool have_traces = !scenarios_.empty() || !playback_.trace_files().empty();
+  if (have_traces && code_block_entry_events_ == 0) {
+    LOG(ERROR) << "No events originated from the given instrumented DLL.";
+    return false;
   }
 
   if (!CalculateReordering(order))
@@ -416,6 +421,21 @@ bool Reorderer::CalculateReordering(Order* order) {
   return true;
 }
 
+bool Reorderer::ConsumeScenarios() {
+  DCHECK(order_generator_ != NULL);
+
+  for (size_t i = 0; i < scenarios_.size(); ++i) {
+    if (!order_generator_->OnScenarioStarted(scenarios_[i])) {
+      LOG(ERROR) << order_generator_->name() << "::OnScenarioStarted failed.";
+      return false;
+    }
+    if (!playback::ConsumeScenario(scenarios_[i], &parser_))
+      return false;
+  }
+
+  return true;
+}
+
 void Reorderer::OnProcessStarted(
     base::Time time, DWORD process_id, const TraceSystemInfo* data) {
   UniqueTime entry_time(time);
@@ -486,6 +506,98 @@ void Reorderer::OnBatchFunctionEntry(base::Time time,
   }
 }
 
+void Reorderer::OnInvocationBatch(base::Time time,
+                                  DWORD process_id,
+                                  DWORD thread_id,
+                                  size_t num_invocations,
+                                  const TraceBatchInvocationInfo* data) {
+  DCHECK(data != NULL);
+
+  for (size_t i = 0; i < num_invocations; ++i) {
+    const InvocationInfo& info = data->invocations[i];
+    // This may happen due to a termination race when the traces are captured.
+    if (info.function == NULL)
+      break;
+
+    // Dynamic symbols never belong to the module being reordered.
+    if ((info.flags & kFunctionIsSymbol) != 0)
+      continue;
+
+    bool error = false;
+    const BlockGraph::Block* callee =
+        playback_.FindFunctionBlock(process_id, info.function, &error);
+    if (error) {
+      LOG(ERROR) << "Playback::FindFunctionBlock failed.";
+      parser_.set_error_occurred(true);
+      return;
+    }
+
+    // If no block was found then we simply ignore the invocation.
+    if (callee == NULL)
+      continue;
+
+    // Calls from outside of the module, including from unknown modules, are
+    // reported with no caller.
+    const BlockGraph::Block* caller = NULL;
+    if ((info.flags & kCallerIsSymbol) == 0 && info.caller != NULL &&
+        parser_.GetModuleInformation(
+            process_id,
+            reinterpret_cast<AbsoluteAddress64>(info.caller)) != NULL) {
+      caller = playback_.FindFunctionBlock(process_id, info.caller, &error);
+      if (error)
+        caller = NULL;
+    }
+
+    ++code_block_entry_events_;
+    if (!order_generator_->OnCallEdge(caller,
+                                      callee,
+                                      process_id,
+                                      thread_id,
+                                      info.num_calls)) {
+      LOG(ERROR) << order_generator_->name() << "::OnCallEdge failed.";
+      parser_.set_error_occurred(true);
+      return;
+    }
+  }
+}
+
+void Reorderer::OnDataPageTouches(base::Time time,
+                                  DWORD process_id,
+                                  const TraceDataPageTouches* data) {
+  DCHECK(data != NULL);
+
+  const ModuleInformation* module_info = parser_.GetModuleInformation(
+      process_id, reinterpret_cast<AbsoluteAddress64>(data->module_base_addr));
+  if (module_info == NULL) {
+    LOG(ERROR) << "Failed to resolve module for data page touches (pid="
+               << process_id << ", addr=0x" << data->module_base_addr << ").";
+    parser_.set_error_occurred(true);
+    return;
+  }
+
+  // Ignore the pages of other modules.
+  if (!playback_.MatchesInstrumentedModuleSignature(*module_info))
+    return;
+
+  // The pages are in first touch order, and so are the blocks of each page.
+  // UniqueTime's incrementing ID preserves that order.
+  block_graph::ConstBlockVector blocks;
+  for (size_t i = 0; i < data->num_pages; ++i) {
+    playback_.FindDataBlocks(RelativeAddress(data->page_rvas[i]),
+                             data->page_size,
+                             &blocks);
+    for (size_t j = 0; j < blocks.size(); ++j) {
+      if (!order_generator_->OnDataBlockTouch(blocks[j],
+                                              process_id,
+                                              UniqueTime(time))) {
+        LOG(ERROR) << order_generator_->name() << "::OnDataBlockTouch failed.";
+        parser_.set_error_occurred(true);
+        return;
+      }
+    }
+  }
+}
+
 bool Reorderer::Order::SerializeToJSON(const PEFile& pe,
                                        const base::FilePath &path,
                                        bool pretty_print) const {
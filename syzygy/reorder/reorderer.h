@@ -33,6 +33,7 @@
 #include "syzygy/pe/decomposer.h"
 #include "syzygy/pe/image_layout.h"
 #include "syzygy/playback/playback.h"
+#include "syzygy/playback/scenario.h"
 #include "syzygy/trace/parse/parser.h"
 
 // Forward declaration.
@@ -53,6 +54,8 @@ class Reorderer : public trace::parser::ParseEventHandlerImpl {
   typedef pe::ImageLayout ImageLayout;
   typedef pe::PEFile PEFile;
   typedef std::vector<base::FilePath> TraceFileList;
+  typedef playback::Scenario Scenario;
+  typedef playback::ScenarioVector ScenarioVector;
 
   struct Order;
   class OrderGenerator;
@@ -98,8 +101,17 @@ class Reorderer : public trace::parser::ParseEventHandlerImpl {
   // @{
   Flags flags() const { return flags_; }
   const Parser& parser() const { return parser_; }
+  const ScenarioVector& scenarios() const { return scenarios_; }
   // @}
 
+  // Sets the scenarios whose trace files are to be analyzed. Each scenario is
+  // consumed in turn, after notifying the order generator. This is used
+  // instead of the trace files given at construction, which must be empty.
+  // @param scenarios the scenarios to analyze.
+  void set_scenarios(const ScenarioVector& scenarios) {
+    scenarios_ = scenarios;
+  }
+
  protected:
   typedef block_graph::BlockGraph BlockGraph;
   typedef core::RelativeAddress RelativeAddress;
@@ -114,6 +126,9 @@ class Reorderer : public trace::parser::ParseEventHandlerImpl {
   // Calculates the actual reordering.
   bool CalculateReordering(Order* order);
 
+  // Consumes the trace files of each scenario in turn.
+  bool ConsumeScenarios();
+
   // @name ParseEventHandler overrides.
   // @{
   virtual void OnProcessStarted(base::Time time,
@@ -128,6 +143,14 @@ class Reorderer : public trace::parser::ParseEventHandlerImpl {
                                     DWORD process_id,
                                     DWORD thread_id,
                                     const TraceBatchEnterData* data) OVERRIDE;
+  virtual void OnInvocationBatch(base::Time time,
+                                 DWORD process_id,
+                                 DWORD thread_id,
+                                 size_t num_invocations,
+                                 const TraceBatchInvocationInfo* data) OVERRIDE;
+  virtual void OnDataPageTouches(base::Time time,
+                                 DWORD process_id,
+                                 const TraceDataPageTouches* data) OVERRIDE;
   // @}
 
   // A playback, which will decompose the image for us.
@@ -136,7 +159,10 @@ class Reorderer : public trace::parser::ParseEventHandlerImpl {
   // A set of flags controlling the reorderer's behaviour.
   Flags flags_;
 
-  // Number of CodeBlockEntry events processed.
+  // The scenarios to analyze, if any.
+  ScenarioVector scenarios_;
+
+  // Number of CodeBlockEntry and CallEdge events processed.
   size_t code_block_entry_events_;
 
   // The following three variables are only valid while Reorder is executing.
@@ -311,6 +337,14 @@ class Reorderer::OrderGenerator {
   // Accessor.
   const std::string& name() const { return name_; }
 
+  // The derived class may implement this callback, which indicates that the
+  // trace files of a new scenario are about to be processed. This is only
+  // called when the reorderer is given scenarios. Returns true on success,
+  // false on error.
+  virtual bool OnScenarioStarted(const playback::Scenario& scenario) {
+    return true;
+  }
+
   // The derived class may implement this callback, which indicates when a
   // process invoking the instrumented module was started.
   virtual bool OnProcessStarted(uint32 process_id,
@@ -333,6 +367,36 @@ class Reorderer::OrderGenerator {
                                 uint32 thread_id,
                                 const UniqueTime& time) = 0;
 
+  // The derived class may implement this callback, which receives the
+  // caller/callee pairs recorded by the profiler (TRACE_BATCH_INVOCATION
+  // events) for the module that is being reordered. Returns true on success,
+  // false on error. If this returns false, no further callbacks will be
+  // processed.
+  // @param caller the code block containing the call site, or NULL if the
+  //     call originated outside of the module.
+  // @param callee the code block that was called.
+  // @param process_id the process in which the calls occurred.
+  // @param thread_id the thread on which the calls occurred.
+  // @param num_calls the number of calls made from @p caller to @p callee.
+  virtual bool OnCallEdge(const BlockGraph::Block* caller,
+                          const BlockGraph::Block* callee,
+                          uint32 process_id,
+                          uint32 thread_id,
+                          uint64 num_calls) { return true; }
+
+  // The derived class may implement this callback, which receives the data
+  // blocks of the module being reordered in the order the pages holding them
+  // were first touched, as recorded by the call trace client when monitoring
+  // data pages. Returns true on success, false on error. If this returns
+  // false, no further callbacks will be processed.
+  // @param block the data block that was touched.
+  // @param process_id the process in which the block was touched.
+  // @param time the time of the touch. Blocks touched in the same process
+  //     are reported with increasing times.
+  virtual bool OnDataBlockTouch(const BlockGraph::Block* block,
+                                uint32 process_id,
+                                const UniqueTime& time) { return true; }
+
   // The derived class shall implement this function, which actually produces
   // the reordering. When this is called, the callee can be assured that the
   // ImageLayout is populated and all traces have been parsed. This must
@@ -0,0 +1,88 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/sampler/fpo_table.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "syzygy/pdb/pdb_constants.h"
+#include "syzygy/pdb/pdb_dbi_stream.h"
+#include "syzygy/pdb/pdb_file.h"
+#include "syzygy/pdb/pdb_reader.h"
+
+namespace sampler {
+
+namespace {
+
+bool EntryStartsBefore(const FPO_DATA& entry1, const FPO_DATA& entry2) {
+  return entry1.ulOffStart < entry2.ulOffStart;
+}
+
+bool RvaBeforeEntryEnd(uint32 rva, const FPO_DATA& entry) {
+  return rva < entry.ulOffStart + entry.cbProcSize;
+}
+
+}  // namespace
+
+bool FpoTable::Init(const base::FilePath& pdb_path) {
+  pdb::PdbReader pdb_reader;
+  pdb::PdbFile pdb_file;
+  if (!pdb_reader.Read(pdb_path, &pdb_file)) {
+    LOG(ERROR) << "Unable to read PDB: " << pdb_path.value();
+    return false;
+  }
+
+  scoped_refptr<pdb::PdbStream> dbi_stream(
+      pdb_file.GetStream(pdb::kDbiStream));
+  pdb::DbiStream dbi;
+  if (dbi_stream.get() == NULL || !dbi.Read(dbi_stream.get())) {
+    LOG(ERROR) << "Unable to read the DBI stream of PDB: "
+               << pdb_path.value();
+    return false;
+  }
+
+  std::vector<FPO_DATA> entries;
+  if (dbi.dbg_header().fpo != -1) {
+    scoped_refptr<pdb::PdbStream> fpo_stream(
+        pdb_file.GetStream(dbi.dbg_header().fpo));
+    if (fpo_stream.get() == NULL || !fpo_stream->Read(&entries)) {
+      LOG(ERROR) << "Unable to read the FPO stream of PDB: "
+                 << pdb_path.value();
+      return false;
+    }
+  }
+
+  InitFromEntries(&entries);
+  return true;
+}
+
+void FpoTable::InitFromEntries(std::vector<FPO_DATA>* entries) {
+  DCHECK(entries != NULL);
+  entries_.swap(*entries);
+  std::sort(entries_.begin(), entries_.end(), EntryStartsBefore);
+}
+
+const FPO_DATA* FpoTable::Find(uint32 rva) const {
+  // Find the first function that ends past the address. Functions don't
+  // overlap, so that's the only one that can contain it.
+  std::vector<FPO_DATA>::const_iterator it =
+      std::upper_bound(entries_.begin(), entries_.end(), rva,
+                       RvaBeforeEntryEnd);
+  if (it == entries_.end() || rva < it->ulOffStart)
+    return NULL;
+  return &(*it);
+}
+
+}  // namespace sampler
@@ -0,0 +1,62 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares FpoTable, the frame pointer omission data of a module as read from
+// its PDB. The stack walker uses it to step over the frames of the functions
+// that don't maintain a frame pointer.
+
+#ifndef SYZYGY_SAMPLER_FPO_TABLE_H_
+#define SYZYGY_SAMPLER_FPO_TABLE_H_
+
+#include <windows.h>
+#include <winnt.h>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/files/file_path.h"
+
+namespace sampler {
+
+class FpoTable {
+ public:
+  FpoTable() { }
+
+  // Reads the FPO data of a module from its PDB. A PDB without FPO data
+  // yields an empty table.
+  // @param pdb_path The path to the PDB of the module.
+  // @returns true on success, false otherwise.
+  bool Init(const base::FilePath& pdb_path);
+
+  // Initializes the table with the given entries.
+  // @param entries The FPO entries. These are swapped into the table.
+  void InitFromEntries(std::vector<FPO_DATA>* entries);
+
+  // Finds the FPO data of the function containing an address.
+  // @param rva The address, relative to the base of the module.
+  // @returns the FPO entry of the function, or NULL if there is none.
+  const FPO_DATA* Find(uint32 rva) const;
+
+  // @returns true iff the table holds no entries.
+  bool empty() const { return entries_.empty(); }
+
+ private:
+  // The FPO entries, sorted by function address.
+  std::vector<FPO_DATA> entries_;
+
+  DISALLOW_COPY_AND_ASSIGN(FpoTable);
+};
+
+}  // namespace sampler
+
+#endif  // SYZYGY_SAMPLER_FPO_TABLE_H_
@@ -0,0 +1,77 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/sampler/fpo_table.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/pe/unittest_util.h"
+
+namespace sampler {
+
+namespace {
+
+FPO_DATA MakeEntry(uint32 start, uint32 size, uint32 locals) {
+  FPO_DATA entry = {};
+  entry.ulOffStart = start;
+  entry.cbProcSize = size;
+  entry.cdwLocals = locals;
+  return entry;
+}
+
+}  // namespace
+
+TEST(FpoTableTest, InitFromPdb) {
+  FpoTable table;
+  EXPECT_TRUE(table.Init(
+      testing::GetExeRelativePath(testing::kTestDllPdbName)));
+}
+
+TEST(FpoTableTest, InitFromMissingPdbFails) {
+  FpoTable table;
+  EXPECT_FALSE(table.Init(
+      testing::GetExeRelativePath(L"this-pdb-does-not-exist.pdb")));
+  EXPECT_TRUE(table.empty());
+}
+
+TEST(FpoTableTest, Find) {
+  std::vector<FPO_DATA> entries;
+  entries.push_back(MakeEntry(0x3000, 0x100, 3));
+  entries.push_back(MakeEntry(0x1000, 0x10, 1));
+  entries.push_back(MakeEntry(0x2000, 0x80, 2));
+
+  FpoTable table;
+  EXPECT_TRUE(table.empty());
+  table.InitFromEntries(&entries);
+  EXPECT_FALSE(table.empty());
+
+  EXPECT_TRUE(table.Find(0x0FFF) == NULL);
+  EXPECT_TRUE(table.Find(0x1010) == NULL);
+  EXPECT_TRUE(table.Find(0x2080) == NULL);
+  EXPECT_TRUE(table.Find(0x3100) == NULL);
+
+  const FPO_DATA* entry = table.Find(0x1000);
+  ASSERT_TRUE(entry != NULL);
+  EXPECT_EQ(1U, entry->cdwLocals);
+
+  entry = table.Find(0x207F);
+  ASSERT_TRUE(entry != NULL);
+  EXPECT_EQ(2U, entry->cdwLocals);
+
+  entry = table.Find(0x3050);
+  ASSERT_TRUE(entry != NULL);
+  EXPECT_EQ(3U, entry->cdwLocals);
+}
+
+}  // namespace sampler
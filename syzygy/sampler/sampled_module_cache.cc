@@ -64,10 +64,28 @@ bool GetModulePath(HANDLE process, HMODULE module, base::FilePath* path) {
   return true;
 }
 
+// Aligns the given RVA range to the bucket size.
+void AlignToBuckets(size_t log2_bucket_size, DWORD* begin, DWORD* end) {
+  DCHECK(begin != NULL);
+  DCHECK(end != NULL);
+
+  DWORD bucket_size = 1 << log2_bucket_size;
+  *begin = (*begin / bucket_size) * bucket_size;
+  *end = ((*end + bucket_size - 1) / bucket_size) * bucket_size;
+}
+
+// Gets the number of buckets needed to cover the given RVA range.
+DWORD GetBucketCount(size_t log2_bucket_size, DWORD begin, DWORD end) {
+  AlignToBuckets(log2_bucket_size, &begin, &end);
+  return (end - begin) >> log2_bucket_size;
+}
+
 }  // namespace
 
 SampledModuleCache::SampledModuleCache(size_t log2_bucket_size)
-      : log2_bucket_size_(log2_bucket_size), module_count_(0) {
+      : log2_bucket_size_(log2_bucket_size),
+        max_bucket_count_(0),
+        module_count_(0) {
   DCHECK_LE(2u, log2_bucket_size);
   DCHECK_GE(31u, log2_bucket_size);
 }
@@ -117,8 +135,10 @@ bool SampledModuleCache::AddModule(HANDLE process,
   }
   DCHECK(proc != NULL);
 
-  if (!proc->AddModule(module_handle, log2_bucket_size_, status, module))
+  if (!proc->AddModule(module_handle, log2_bucket_size_, max_bucket_count_,
+                       status, module)) {
     return false;
+  }
 
   DCHECK(*module != NULL);
   if (*status == kProfilingStarted)
@@ -187,6 +207,7 @@ bool SampledModuleCache::Process::Init() {
 
 bool SampledModuleCache::Process::AddModule(HMODULE module_handle,
                                             size_t log2_bucket_size,
+                                            size_t max_bucket_count,
                                             ProfilingStatus* status,
                                             const Module** module) {
   DCHECK(module != INVALID_HANDLE_VALUE);
@@ -212,7 +233,8 @@ bool SampledModuleCache::Process::AddModule(HMODULE module_handle,
 
   // Create a new module object. We don't actually insert it into the map until
   // everything has succeeded, saving us the cleanup on failure.
-  scoped_ptr<Module> mod(new Module(this, module_handle, log2_bucket_size));
+  scoped_ptr<Module> mod(new Module(this, module_handle, log2_bucket_size,
+                                    max_bucket_count));
 
   if (!mod->Init())
     return false;
@@ -266,7 +288,8 @@ void SampledModuleCache::Process::RemoveDeadModules(
 
 SampledModuleCache::Module::Module(Process* process,
                                    HMODULE module,
-                                   size_t log2_bucket_size)
+                                   size_t log2_bucket_size,
+                                   size_t max_bucket_count)
     : process_(process),
       module_(module),
       module_size_(0),
@@ -275,8 +298,10 @@ SampledModuleCache::Module::Module(Process* process,
       buckets_begin_(NULL),
       buckets_end_(NULL),
       log2_bucket_size_(log2_bucket_size),
+      max_bucket_count_(max_bucket_count),
       profiling_start_time_(0),
       profiling_stop_time_(0),
+      last_flush_time_(0),
       alive_(true) {
   DCHECK(process != NULL);
   DCHECK(module_ != INVALID_HANDLE_VALUE);
@@ -364,10 +389,19 @@ bool SampledModuleCache::Module::Init() {
       text_end = sec_end;
   }
 
+  // Grow the bucket size until the buckets fit in the maximum count, if any.
+  // This keeps the histograms of large modules at a manageable size.
+  if (max_bucket_count_ != 0) {
+    while (log2_bucket_size_ < 31 &&
+           GetBucketCount(log2_bucket_size_, text_begin, text_end) >
+               max_bucket_count_) {
+      ++log2_bucket_size_;
+    }
+  }
+
   // Adjust the address range for the bucket size.
   DWORD bucket_size = 1 << log2_bucket_size_;
-  text_begin = (text_begin / bucket_size) * bucket_size;
-  text_end = ((text_end + bucket_size - 1) / bucket_size) * bucket_size;
+  AlignToBuckets(log2_bucket_size_, &text_begin, &text_end);
 
   // Calculate the number of buckets.
   DCHECK_EQ(0u, (text_end - text_begin) % bucket_size);
@@ -400,6 +434,7 @@ bool SampledModuleCache::Module::Start() {
   if (!profiler_.Start())
     return false;
   profiling_start_time_ = trace::common::GetTsc();
+  last_flush_time_ = profiling_start_time_;
   return true;
 }
 
@@ -410,4 +445,42 @@ bool SampledModuleCache::Module::Stop() {
   return true;
 }
 
+void SampledModuleCache::Module::FlushSamples(std::vector<ULONG>* buckets,
+                                              uint64* start_time,
+                                              uint64* end_time) {
+  DCHECK(buckets != NULL);
+  DCHECK(start_time != NULL);
+  DCHECK(end_time != NULL);
+
+  // The kernel keeps updating the buckets while we profile, so take a
+  // snapshot of them to compute the samples since the last flush.
+  std::vector<ULONG> snapshot(profiler_.buckets().begin(),
+                              profiler_.buckets().end());
+  *start_time = last_flush_time_;
+  *end_time = trace::common::GetTsc();
+
+  buckets->resize(snapshot.size());
+  for (size_t i = 0; i < snapshot.size(); ++i) {
+    (*buckets)[i] = snapshot[i];
+    if (!flushed_buckets_.empty())
+      (*buckets)[i] -= flushed_buckets_[i];
+  }
+
+  flushed_buckets_.swap(snapshot);
+  last_flush_time_ = *end_time;
+}
+
+void SampledModuleCache::Module::GetUnflushedSamples(
+    std::vector<ULONG>* buckets) const {
+  DCHECK(buckets != NULL);
+
+  buckets->assign(profiler_.buckets().begin(), profiler_.buckets().end());
+  if (flushed_buckets_.empty())
+    return;
+
+  DCHECK_EQ(flushed_buckets_.size(), buckets->size());
+  for (size_t i = 0; i < buckets->size(); ++i)
+    (*buckets)[i] -= flushed_buckets_[i];
+}
+
 }  // namespace sampler
@@ -21,8 +21,11 @@
 // Because of the polling nature the cache contains mechanisms for doing mark
 // and sweep garbage collection. It is intended to be used as follows:
 //
-// // All modules will be profiled with the same bucket size.
+// // All modules will be profiled with the same bucket size, unless a
+// // maximum bucket count is set, in which case the bucket size is grown as
+// // needed for large modules.
 // SampledModuleCache cache(log2_bucket_size);
+// cache.set_max_bucket_count(max_bucket_count);
 //
 // // Set up a callback that will be invoked when profiling is done for a
 // // module.
@@ -45,12 +48,17 @@
 //   // Clean up any modules that haven't been added (or re-added and marked as
 //   // alive). This invokes our callback with the gathered profile data.
 //   cache.RemoveDeadModules();
+//
+//   // Optionally, periodically take the samples gathered since the last flush
+//   // for each module with Module::FlushSamples. The dead module callback can
+//   // then limit itself to the samples not flushed yet.
 // }
 
 #ifndef SYZYGY_SAMPLER_SAMPLED_MODULE_CACHE_H_
 #define SYZYGY_SAMPLER_SAMPLED_MODULE_CACHE_H_
 
 #include <map>
+#include <vector>
 
 #include "base/basictypes.h"
 #include "base/callback.h"
@@ -100,10 +108,20 @@ class SampledModuleCache {
     dead_module_callback_ = callback;
   }
 
+  // Sets the maximum number of buckets used to profile a module. The bucket
+  // size of the modules that would need more buckets is doubled until they
+  // fit. A value of zero means there is no maximum, which is the default.
+  // This only applies to the modules added afterwards.
+  // @param max_bucket_count The maximum number of buckets per module.
+  void set_max_bucket_count(size_t max_bucket_count) {
+    max_bucket_count_ = max_bucket_count;
+  }
+
   // @name Accessors.
   // @{
   const ProcessMap& processes() const { return processes_; }
   size_t log2_bucket_size() const { return log2_bucket_size_; }
+  size_t max_bucket_count() const { return max_bucket_count_; }
   const DeadModuleCallback& dead_module_callback() const {
     return dead_module_callback_;
   }
@@ -146,6 +164,10 @@ class SampledModuleCache {
   // cache.
   size_t log2_bucket_size_;
 
+  // The maximum number of buckets per profiler instance, or zero if there is
+  // no maximum.
+  size_t max_bucket_count_;
+
   // The callback that is being invoked when dead modules are removed, or when
   // the entire cache is being destroyed.
   DeadModuleCallback dead_module_callback_;
@@ -195,6 +217,8 @@ class SampledModuleCache::Process {
   //     by the sampling profiler. This must be in the range 2-31, for bucket
   //     sizes of 4 bytes to 2 gigabytes. See base/win/sampling_profiler.h
   //     for more details.
+  // @param max_bucket_count The maximum number of buckets to be used by the
+  //     sampling profiler, or zero if there is no maximum.
   // @param status The status of the profiled module. This will only be set on
   //     success.
   // @param module A pointer to the added module. This will only be non-NULL on
@@ -202,6 +226,7 @@ class SampledModuleCache::Process {
   // @returns true on success, false otherwise.
   bool AddModule(HMODULE module_handle,
                  size_t log2_bucket_size,
+                 size_t max_bucket_count,
                  ProfilingStatus* status,
                  const Module** module);
 
@@ -257,8 +282,14 @@ class SampledModuleCache::Module {
   // @param log2_bucket_size The number of bits in the bucket size to be used
   //     by the sampling profiler. This must be in the range 2-31, for bucket
   //     sizes of 4 bytes to 2 gigabytes. See base/win/sampling_profiler.h
-  //     for more details.
-  Module(Process* process, HMODULE module, size_t log2_bucket_size);
+  //     for more details. This is a minimum if @p max_bucket_count is not
+  //     zero.
+  // @param max_bucket_count The maximum number of buckets to be used by the
+  //     sampling profiler, or zero if there is no maximum.
+  Module(Process* process,
+         HMODULE module,
+         size_t log2_bucket_size,
+         size_t max_bucket_count);
 
   // @name Accessors.
   // @{
@@ -274,10 +305,27 @@ class SampledModuleCache::Module {
   size_t log2_bucket_size() const { return log2_bucket_size_; }
   uint64 profiling_start_time() const { return profiling_start_time_; }
   uint64 profiling_stop_time() const { return profiling_stop_time_; }
+  uint64 last_flush_time() const { return last_flush_time_; }
   base::win::SamplingProfiler& profiler() { return profiler_; }
   const base::win::SamplingProfiler& profiler() const { return profiler_; }
   // @}
 
+  // Takes the samples gathered since the last flush, or since profiling
+  // started if there was no flush yet.
+  // @param buckets Will receive the number of samples per bucket.
+  // @param start_time Will receive the time of the last flush, as reported by
+  //     RDTSC.
+  // @param end_time Will receive the time of this flush, as reported by
+  //     RDTSC.
+  void FlushSamples(std::vector<ULONG>* buckets,
+                    uint64* start_time,
+                    uint64* end_time);
+
+  // Gets the samples gathered since the last flush. This is meant for modules
+  // that stopped profiling, whose samples no longer change.
+  // @param buckets Will receive the number of samples per bucket.
+  void GetUnflushedSamples(std::vector<ULONG>* buckets) const;
+
  protected:
   friend class SampledModuleCache;
 
@@ -328,12 +376,18 @@ class SampledModuleCache::Module {
   const void* buckets_begin_;
   const void* buckets_end_;
   size_t log2_bucket_size_;
+  size_t max_bucket_count_;
 
   // The time when we started and stopped profiling this module, as reported by
   // RDTSC.
   uint64 profiling_start_time_;
   uint64 profiling_stop_time_;
 
+  // The samples per bucket as of the last flush, and the time of the flush as
+  // reported by RDTSC. The buckets are empty until the first flush.
+  std::vector<ULONG> flushed_buckets_;
+  uint64 last_flush_time_;
+
   // The sampling profiler instance that is profiling this module.
   base::win::SamplingProfiler profiler_;
 
@@ -14,6 +14,8 @@
 
 #include "syzygy/sampler/sampled_module_cache.h"
 
+#include <vector>
+
 #include "base/bind.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -48,6 +50,10 @@ class SampledModuleCacheTest : public ::testing::Test {
 TEST_F(SampledModuleCacheTest, ConstructorAndProperties) {
   SampledModuleCache cache(2);
   EXPECT_EQ(2u, cache.log2_bucket_size());
+  EXPECT_EQ(0u, cache.max_bucket_count());
+
+  cache.set_max_bucket_count(1024);
+  EXPECT_EQ(1024u, cache.max_bucket_count());
 
   EXPECT_TRUE(cache.dead_module_callback().is_null());
   cache.set_dead_module_callback(dead_module_callback);
@@ -141,4 +147,73 @@ TEST_F(SampledModuleCacheTest, EndToEnd) {
   EXPECT_EQ(0u, cache.module_count());
 }
 
+TEST_F(SampledModuleCacheTest, MaxBucketCount) {
+  SampledModuleCache cache(2);
+  cache.set_max_bucket_count(16);
+
+  static const DWORD kAccess =
+      PROCESS_DUP_HANDLE | PROCESS_QUERY_INFORMATION | PROCESS_VM_READ;
+  base::win::ScopedHandle proc(
+      ::OpenProcess(kAccess, FALSE, ::GetCurrentProcessId()));
+  ASSERT_TRUE(proc.IsValid());
+
+  SampledModuleCache::ProfilingStatus status =
+      SampledModuleCache::kProfilingStarted;
+  const SampledModuleCache::Module* module = NULL;
+  HMODULE module_handle = ::GetModuleHandle(NULL);
+  ASSERT_TRUE(cache.AddModule(proc.Get(), module_handle, &status, &module));
+  ASSERT_TRUE(module != NULL);
+
+  // The code of the unittest binary is far bigger than 16 buckets of 4 bytes,
+  // so the bucket size must have grown.
+  EXPECT_LT(2u, module->log2_bucket_size());
+  EXPECT_GE(16u, module->profiler().buckets().size());
+  EXPECT_LT(0u, module->profiler().buckets().size());
+}
+
+TEST_F(SampledModuleCacheTest, FlushSamples) {
+  SampledModuleCache cache(2);
+
+  static const DWORD kAccess =
+      PROCESS_DUP_HANDLE | PROCESS_QUERY_INFORMATION | PROCESS_VM_READ;
+  base::win::ScopedHandle proc(
+      ::OpenProcess(kAccess, FALSE, ::GetCurrentProcessId()));
+  ASSERT_TRUE(proc.IsValid());
+
+  SampledModuleCache::ProfilingStatus status =
+      SampledModuleCache::kProfilingStarted;
+  const SampledModuleCache::Module* module = NULL;
+  HMODULE module_handle = ::GetModuleHandle(NULL);
+  ASSERT_TRUE(cache.AddModule(proc.Get(), module_handle, &status, &module));
+  ASSERT_TRUE(module != NULL);
+
+  SampledModuleCache::Module* mutable_module =
+      cache.processes().begin()->second->modules().begin()->second;
+  ASSERT_EQ(module, mutable_module);
+  EXPECT_EQ(module->profiling_start_time(), module->last_flush_time());
+
+  // The first flush covers the time since profiling started.
+  std::vector<ULONG> samples;
+  uint64 start_time = 0;
+  uint64 end_time = 0;
+  mutable_module->FlushSamples(&samples, &start_time, &end_time);
+  EXPECT_EQ(module->profiler().buckets().size(), samples.size());
+  EXPECT_EQ(module->profiling_start_time(), start_time);
+  EXPECT_LE(start_time, end_time);
+  EXPECT_EQ(end_time, module->last_flush_time());
+
+  // The next one picks up where it left off.
+  uint64 previous_end_time = end_time;
+  mutable_module->FlushSamples(&samples, &start_time, &end_time);
+  EXPECT_EQ(previous_end_time, start_time);
+  EXPECT_LE(start_time, end_time);
+
+  // The samples that were flushed aren't reported again.
+  std::vector<ULONG> unflushed;
+  module->GetUnflushedSamples(&unflushed);
+  ASSERT_EQ(module->profiler().buckets().size(), unflushed.size());
+  for (size_t i = 0; i < unflushed.size(); ++i)
+    EXPECT_GE(module->profiler().buckets()[i], unflushed[i]);
+}
+
 }  // namespace sampler
@@ -0,0 +1,124 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/sampler/sampled_stack_table.h"
+
+#include "base/logging.h"
+#include "base/stl_util.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
+
+namespace sampler {
+
+SampledStackTable::SampledStackTable() {
+}
+
+SampledStackTable::~SampledStackTable() {
+  STLDeleteElements(&stacks_);
+}
+
+void SampledStackTable::AddSample(const Frames& frames) {
+  DCHECK(!frames.empty());
+
+  Stack key = {};
+  key.hash = ComputeStackHash(frames);
+  key.frames = frames;
+
+  Stack* stack = NULL;
+  StackSet::iterator it = stacks_.find(&key);
+  if (it != stacks_.end()) {
+    stack = *it;
+  } else {
+    stack = new Stack(key);
+    stack->id = stacks_.size();
+    stacks_.insert(stack);
+  }
+
+  if (stack->count == 0)
+    sampled_stacks_.push_back(stack);
+  ++stack->count;
+}
+
+bool SampledStackTable::Flush(uint64 start_time,
+                              uint64 end_time,
+                              uint64 interval,
+                              std::vector<uint8>* buffer) {
+  DCHECK(buffer != NULL);
+
+  if (sampled_stacks_.empty())
+    return false;
+
+  size_t num_frames = 0;
+  for (size_t i = 0; i < sampled_stacks_.size(); ++i) {
+    if (!sampled_stacks_[i]->written)
+      num_frames += sampled_stacks_[i]->frames.size();
+  }
+
+  buffer->resize(
+      FIELD_OFFSET(TraceSampleStacks, stacks) +
+      sampled_stacks_.size() * sizeof(TraceSampleStack) +
+      num_frames * sizeof(ModuleAddr));
+  TraceSampleStacks* record =
+      reinterpret_cast<TraceSampleStacks*>(&buffer->at(0));
+  record->sampling_start_time = start_time;
+  record->sampling_end_time = end_time;
+  record->sampling_interval = interval;
+  record->num_stacks = sampled_stacks_.size();
+  record->num_frames = num_frames;
+
+  ModuleAddr* frame =
+      reinterpret_cast<ModuleAddr*>(record->stacks + record->num_stacks);
+  for (size_t i = 0; i < sampled_stacks_.size(); ++i) {
+    Stack* stack = sampled_stacks_[i];
+    TraceSampleStack& stack_record = record->stacks[i];
+    stack_record.stack_id = stack->id;
+    stack_record.count = stack->count;
+    stack_record.num_frames = 0;
+    if (!stack->written) {
+      stack_record.num_frames = stack->frames.size();
+      for (size_t j = 0; j < stack->frames.size(); ++j, ++frame)
+        *frame = reinterpret_cast<ModuleAddr>(stack->frames[j]);
+      stack->written = true;
+    }
+    stack->count = 0;
+  }
+  DCHECK_EQ(&buffer->at(0) + buffer->size(),
+            reinterpret_cast<uint8*>(frame));
+
+  sampled_stacks_.clear();
+  return true;
+}
+
+uint32 SampledStackTable::ComputeStackHash(const Frames& frames) {
+  uint32 hash = 0;
+  for (size_t i = 0; i < frames.size(); ++i)
+    hash += frames[i];
+  return hash;
+}
+
+size_t SampledStackTable::Stack::HashCompare::operator()(
+    const Stack* stack) const {
+  DCHECK(stack != NULL);
+  return stack->hash;
+}
+
+bool SampledStackTable::Stack::HashCompare::operator()(
+    const Stack* stack1, const Stack* stack2) const {
+  DCHECK(stack1 != NULL);
+  DCHECK(stack2 != NULL);
+  if (stack1->hash != stack2->hash)
+    return stack1->hash < stack2->hash;
+  return stack1->frames < stack2->frames;
+}
+
+}  // namespace sampler
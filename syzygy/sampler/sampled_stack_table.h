@@ -0,0 +1,99 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares SampledStackTable, which deduplicates the stacks sampled in a
+// process and counts their samples. Each distinct stack is given an ID, and
+// its frames are only written to the trace the first time it's flushed.
+// Stacks are hashed by summing their frames, as the asan agent does for its
+// stack captures.
+
+#ifndef SYZYGY_SAMPLER_SAMPLED_STACK_TABLE_H_
+#define SYZYGY_SAMPLER_SAMPLED_STACK_TABLE_H_
+
+#include <vector>
+
+#include "base/hash_tables.h"
+#include "syzygy/sampler/stack_walker.h"
+
+namespace sampler {
+
+class SampledStackTable {
+ public:
+  typedef StackWalker::Frames Frames;
+
+  SampledStackTable();
+  ~SampledStackTable();
+
+  // Records a sample of a stack.
+  // @param frames The frames of the stack, innermost first.
+  void AddSample(const Frames& frames);
+
+  // Serializes the stacks sampled since the last flush to a TraceSampleStacks
+  // record, and resets their counts.
+  // @param start_time The time when the period of the record started.
+  // @param end_time The time when the period of the record ended.
+  // @param interval The sampling interval, in clock cycles.
+  // @param buffer Receives the record.
+  // @returns false if no stack was sampled since the last flush, in which
+  //     case @p buffer is left untouched, true otherwise.
+  bool Flush(uint64 start_time,
+             uint64 end_time,
+             uint64 interval,
+             std::vector<uint8>* buffer);
+
+  // @returns the number of distinct stacks sampled so far.
+  size_t size() const { return stacks_.size(); }
+
+  // Computes the hash of a stack.
+  // @param frames The frames of the stack.
+  // @returns the hash of the stack.
+  static uint32 ComputeStackHash(const Frames& frames);
+
+ protected:
+  // A distinct stack.
+  struct Stack {
+    uint32 hash;
+    uint32 id;
+    // The number of samples since the last flush.
+    uint32 count;
+    // True once the frames were written to a record.
+    bool written;
+    Frames frames;
+
+    // The hash comparison functor for use with MSDN's stdext::hash_set.
+    struct HashCompare {
+      static const size_t bucket_size = 4;
+      static const size_t min_buckets = 8;
+      // Calculates a hash value for the given stack.
+      size_t operator()(const Stack* stack) const;
+      // Value comparison operator. Unlike the asan stack cache, stacks that
+      // collide are told apart by their frames.
+      bool operator()(const Stack* stack1, const Stack* stack2) const;
+    };
+  };
+
+  // The distinct stacks, owned by the table.
+  typedef base::hash_set<Stack*, Stack::HashCompare> StackSet;
+  StackSet stacks_;
+
+  // The stacks sampled since the last flush.
+  std::vector<Stack*> sampled_stacks_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(SampledStackTable);
+};
+
+}  // namespace sampler
+
+#endif  // SYZYGY_SAMPLER_SAMPLED_STACK_TABLE_H_
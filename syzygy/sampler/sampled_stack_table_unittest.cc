@@ -0,0 +1,130 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/sampler/sampled_stack_table.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
+
+namespace sampler {
+
+namespace {
+
+typedef SampledStackTable::Frames Frames;
+
+Frames MakeFrames(uint32 frame1, uint32 frame2) {
+  Frames frames;
+  frames.push_back(frame1);
+  frames.push_back(frame2);
+  return frames;
+}
+
+const ModuleAddr* GetFrames(const TraceSampleStacks* record) {
+  return reinterpret_cast<const ModuleAddr*>(
+      record->stacks + record->num_stacks);
+}
+
+}  // namespace
+
+TEST(SampledStackTableTest, ComputeStackHash) {
+  EXPECT_EQ(0x3000U,
+            SampledStackTable::ComputeStackHash(MakeFrames(0x1000, 0x2000)));
+}
+
+TEST(SampledStackTableTest, FlushEmptyTable) {
+  SampledStackTable table;
+  std::vector<uint8> buffer;
+  EXPECT_FALSE(table.Flush(0, 10, 1, &buffer));
+  EXPECT_TRUE(buffer.empty());
+}
+
+TEST(SampledStackTableTest, DeduplicatesStacks) {
+  SampledStackTable table;
+
+  // The two last stacks collide, but are distinct.
+  Frames stack1 = MakeFrames(0x1000, 0x2000);
+  Frames stack2 = MakeFrames(0x1100, 0x2000);
+  Frames stack3 = MakeFrames(0x2000, 0x1100);
+  table.AddSample(stack1);
+  table.AddSample(stack2);
+  table.AddSample(stack1);
+  table.AddSample(stack3);
+  EXPECT_EQ(3U, table.size());
+
+  std::vector<uint8> buffer;
+  ASSERT_TRUE(table.Flush(100, 200, 10, &buffer));
+  ASSERT_LE(FIELD_OFFSET(TraceSampleStacks, stacks), buffer.size());
+  const TraceSampleStacks* record =
+      reinterpret_cast<const TraceSampleStacks*>(&buffer[0]);
+  EXPECT_EQ(100U, record->sampling_start_time);
+  EXPECT_EQ(200U, record->sampling_end_time);
+  EXPECT_EQ(10U, record->sampling_interval);
+  ASSERT_EQ(3U, record->num_stacks);
+  ASSERT_EQ(6U, record->num_frames);
+  EXPECT_EQ(FIELD_OFFSET(TraceSampleStacks, stacks) +
+                3 * sizeof(TraceSampleStack) + 6 * sizeof(ModuleAddr),
+            buffer.size());
+
+  // The stacks are written in the order they were first sampled.
+  EXPECT_EQ(0U, record->stacks[0].stack_id);
+  EXPECT_EQ(2U, record->stacks[0].count);
+  EXPECT_EQ(2U, record->stacks[0].num_frames);
+  EXPECT_EQ(1U, record->stacks[1].stack_id);
+  EXPECT_EQ(1U, record->stacks[1].count);
+  EXPECT_EQ(2U, record->stacks[2].stack_id);
+  EXPECT_EQ(1U, record->stacks[2].count);
+
+  const ModuleAddr* frames = GetFrames(record);
+  EXPECT_EQ(reinterpret_cast<ModuleAddr>(0x1000), frames[0]);
+  EXPECT_EQ(reinterpret_cast<ModuleAddr>(0x2000), frames[1]);
+  EXPECT_EQ(reinterpret_cast<ModuleAddr>(0x1100), frames[2]);
+  EXPECT_EQ(reinterpret_cast<ModuleAddr>(0x2000), frames[3]);
+  EXPECT_EQ(reinterpret_cast<ModuleAddr>(0x2000), frames[4]);
+  EXPECT_EQ(reinterpret_cast<ModuleAddr>(0x1100), frames[5]);
+}
+
+TEST(SampledStackTableTest, WritesFramesOnlyOnce) {
+  SampledStackTable table;
+  Frames stack1 = MakeFrames(0x1000, 0x2000);
+  Frames stack2 = MakeFrames(0x3000, 0x4000);
+  table.AddSample(stack1);
+
+  std::vector<uint8> buffer;
+  ASSERT_TRUE(table.Flush(0, 10, 1, &buffer));
+
+  // Nothing was sampled since.
+  EXPECT_FALSE(table.Flush(10, 20, 1, &buffer));
+
+  table.AddSample(stack2);
+  table.AddSample(stack1);
+  table.AddSample(stack1);
+  ASSERT_TRUE(table.Flush(20, 30, 1, &buffer));
+  const TraceSampleStacks* record =
+      reinterpret_cast<const TraceSampleStacks*>(&buffer[0]);
+  ASSERT_EQ(2U, record->num_stacks);
+  ASSERT_EQ(2U, record->num_frames);
+
+  EXPECT_EQ(1U, record->stacks[0].stack_id);
+  EXPECT_EQ(1U, record->stacks[0].count);
+  EXPECT_EQ(2U, record->stacks[0].num_frames);
+  EXPECT_EQ(0U, record->stacks[1].stack_id);
+  EXPECT_EQ(2U, record->stacks[1].count);
+  EXPECT_EQ(0U, record->stacks[1].num_frames);
+
+  const ModuleAddr* frames = GetFrames(record);
+  EXPECT_EQ(reinterpret_cast<ModuleAddr>(0x3000), frames[0]);
+  EXPECT_EQ(reinterpret_cast<ModuleAddr>(0x4000), frames[1]);
+}
+
+}  // namespace sampler
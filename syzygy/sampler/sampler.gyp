@@ -21,14 +21,21 @@
       'target_name': 'sampler_lib',
       'type': 'static_library',
       'sources': [
+        'fpo_table.cc',
+        'fpo_table.h',
         'sampler_app.cc',
         'sampler_app.h',
         'sampled_module_cache.cc',
         'sampled_module_cache.h',
+        'sampled_stack_table.cc',
+        'sampled_stack_table.h',
+        'stack_walker.cc',
+        'stack_walker.h',
       ],
       'dependencies': [
         '<(src)/base/base.gyp:base',
         '<(src)/syzygy/common/common.gyp:common_lib',
+        '<(src)/syzygy/pdb/pdb.gyp:pdb_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
         '<(src)/syzygy/trace/common/common.gyp:trace_common_lib',
         '<(src)/syzygy/trace/service/service.gyp:rpc_service_lib',
@@ -66,9 +73,12 @@
       'target_name': 'sampler_unittests',
       'type': 'executable',
       'sources': [
+        'fpo_table_unittest.cc',
         'sampled_module_cache_unittest.cc',
+        'sampled_stack_table_unittest.cc',
         'sampler_app_unittest.cc',
         'sampler_unittests_main.cc',
+        'stack_walker_unittest.cc',
       ],
       'dependencies': [
         'sampler_lib',
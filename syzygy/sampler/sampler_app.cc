@@ -15,14 +15,19 @@
 #include "syzygy/sampler/sampler_app.h"
 
 #include <psapi.h>
+#include <tlhelp32.h>
+#include <algorithm>
 
 #include "base/bind.h"
 #include "base/file_util.h"
+#include "base/string_util.h"
 #include "base/stringprintf.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/strings/string_number_conversions.h"
 #include "base/strings/string_split.h"
 #include "syzygy/common/align.h"
 #include "syzygy/common/buffer_writer.h"
+#include "syzygy/pe/find.h"
 #include "syzygy/pe/pe_file.h"
 #include "syzygy/trace/common/clock.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
@@ -51,6 +56,16 @@ const char kUsageFormatStr[] =
     "                        the list is a whitelist.\n"
     "  --bucket-size=POSINT  Specifies the bucket size. This must be a power\n"
     "                        of two, and must be >= 4. Defaults to 4.\n"
+    "  --flush-interval=INTERVAL\n"
+    "                        Periodically writes the samples gathered since\n"
+    "                        the previous flush. This is a floating point\n"
+    "                        value in seconds. By default the samples are\n"
+    "                        only written when a module stops being\n"
+    "                        profiled.\n"
+    "  --max-buckets=POSINT  Specifies the maximum number of buckets used to\n"
+    "                        profile a module. The bucket size of larger\n"
+    "                        modules is doubled until they fit. Defaults to\n"
+    "                        no maximum.\n"
     "  --output-dir=DIR      The path to write trace-files. Will be created\n"
     "                        if it doesn't exist. Defaults to the current\n"
     "                        working directory.\n"
@@ -58,6 +73,13 @@ const char kUsageFormatStr[] =
     "                        used as a filter (by default a whitelist) for\n"
     "                        processes to be profiled. If not specified all\n"
     "                        processes will be potentially profiled.\n"
+    "  --process-names=NAME1,NAME2,...\n"
+    "                        Specifies a list of executable names, such as\n"
+    "                        chrome.exe. If specified, only the processes\n"
+    "                        running one of these executables are profiled.\n"
+    "  --sample-stacks       Also samples the call stacks of the threads of\n"
+    "                        the profiled processes, by suspending them and\n"
+    "                        walking their stacks.\n"
     "  --sampling-interval=INTERVAL\n"
     "                        Sets the sampling interval. This is a floating\n"
     "                        point value in seconds. Scientific notation is\n"
@@ -66,6 +88,10 @@ const char kUsageFormatStr[] =
     "                        available on all systems so the closest value\n"
     "                        available will be used. The actual sampling\n"
     "                        interval used will be reported.\n"
+    "  --stack-sampling-rate=POSINT\n"
+    "                        The number of times per second the stacks are\n"
+    "                        sampled with --sample-stacks. Must be at most\n"
+    "                        1000. Defaults to 100.\n"
     "  --output-dir=DIR      Specifies the output directory into which trace\n"
     "                        files will be written.\n"
     "\n";
@@ -140,6 +166,82 @@ bool ParseSamplingInterval(const CommandLine* command_line,
   return true;
 }
 
+// Parses the flush interval. Leaves the value unchanged if it is not
+// specified.
+bool ParseFlushInterval(const CommandLine* command_line,
+                        base::TimeDelta* flush_interval) {
+  DCHECK(command_line != NULL);
+  DCHECK(flush_interval != NULL);
+
+  if (!command_line->HasSwitch(SamplerApp::kFlushInterval))
+    return true;
+
+  std::string s = command_line->GetSwitchValueASCII(
+      SamplerApp::kFlushInterval);
+  double d = 0;
+  if (!base::StringToDouble(s, &d) || d <= 0) {
+    LOG(ERROR) << "--" << SamplerApp::kFlushInterval
+               << " must be a positive double.";
+    return false;
+  }
+
+  int64 ms = static_cast<int64>(1000 * d);
+  if (ms <= 0) {
+    LOG(ERROR) << "--" << SamplerApp::kFlushInterval
+               << " must be at least 1ms.";
+    return false;
+  }
+
+  *flush_interval = base::TimeDelta::FromMilliseconds(ms);
+  return true;
+}
+
+// Parses the maximum bucket count. Leaves the value unchanged if it is not
+// specified.
+bool ParseMaxBucketCount(const CommandLine* command_line,
+                         size_t* max_bucket_count) {
+  DCHECK(command_line != NULL);
+  DCHECK(max_bucket_count != NULL);
+
+  if (!command_line->HasSwitch(SamplerApp::kMaxBucketCount))
+    return true;
+
+  std::string s = command_line->GetSwitchValueASCII(
+      SamplerApp::kMaxBucketCount);
+  size_t count = 0;
+  if (!base::StringToSizeT(s, &count) || count == 0) {
+    LOG(ERROR) << "--" << SamplerApp::kMaxBucketCount
+               << " must be a positive integer.";
+    return false;
+  }
+
+  *max_bucket_count = count;
+  return true;
+}
+
+// Parses the stack sampling rate. Leaves the value unchanged if it is not
+// specified.
+bool ParseStackSamplingRate(const CommandLine* command_line,
+                            size_t* stack_sampling_rate) {
+  DCHECK(command_line != NULL);
+  DCHECK(stack_sampling_rate != NULL);
+
+  if (!command_line->HasSwitch(SamplerApp::kStackSamplingRate))
+    return true;
+
+  std::string s = command_line->GetSwitchValueASCII(
+      SamplerApp::kStackSamplingRate);
+  size_t rate = 0;
+  if (!base::StringToSizeT(s, &rate) || rate == 0 || rate > 1000) {
+    LOG(ERROR) << "--" << SamplerApp::kStackSamplingRate
+               << " must be an integer in [1, 1000].";
+    return false;
+  }
+
+  *stack_sampling_rate = rate;
+  return true;
+}
+
 // A utility function for converting a time delta to a human readable string.
 const std::string TimeDeltaToString(const base::TimeDelta& td) {
   // Aliases to constants from base::Time (which have overly long names).
@@ -391,13 +493,44 @@ bool GetModuleSignature(HANDLE process,
   return true;
 }
 
+// Gets the lower-case name of the executable running in the given process.
+// If the process has since exited this returns true but sets @p name to an
+// empty string. Returns false on any other failure.
+bool GetProcessName(HANDLE process, std::wstring* name) {
+  DCHECK(process != NULL);
+  DCHECK(name != NULL);
+
+  wchar_t buffer[MAX_PATH] = {};
+  DWORD length = ::GetModuleBaseNameW(process, NULL, buffer,
+                                      arraysize(buffer));
+  if (length == 0) {
+    DWORD error = ::GetLastError();
+
+    // A process that has exited, or that is 64-bit, has no module list to
+    // get the name from.
+    if (error == ERROR_PARTIAL_COPY || error == ERROR_INVALID_HANDLE) {
+      name->clear();
+      return true;
+    }
+
+    LOG(ERROR) << "GetModuleBaseNameW failed: " << com::LogWe(error);
+    return false;
+  }
+
+  name->assign(buffer, length);
+  StringToLowerASCII(name);
+  return true;
+}
+
 typedef base::Callback<void (const SampledModuleCache::Module*)>
     StartProfilingCallback;
 
 // Attaches to the running process with the specified PID and iterates over
-// its modules. If any of them is found in the list of modules to be profiled
-// adds the process/module pair to the sample module cache.
+// its modules. If the process runs one of the executables of interest, if any,
+// and any of its modules is found in the list of modules to be profiled adds
+// the process/module pair to the sample module cache.
 bool InspectProcessModules(DWORD pid,
+                           const SamplerApp::ProcessNameSet& process_names,
                            SamplerApp::ModuleSignatureSet& module_sigs,
                            StartProfilingCallback callback,
                            SampledModuleCache* cache) {
@@ -413,6 +546,15 @@ bool InspectProcessModules(DWORD pid,
   if (!handle.IsValid())
     return true;
 
+  // Skip over this process if it doesn't run an executable of interest.
+  if (!process_names.empty()) {
+    std::wstring process_name;
+    if (!GetProcessName(handle.Get(), &process_name))
+      return false;
+    if (process_names.find(process_name) == process_names.end())
+      return true;
+  }
+
   // Get a list of modules in the process.
   HmoduleVector modules;
   if (!GetProcessModules(handle.Get(), &modules))
@@ -525,16 +667,19 @@ bool WriteTraceModuleDataRecord(const SampledModuleCache::Module* module,
   return true;
 }
 
-// Converts the sample data in |module| to a TraceSampleData buffer and outputs
-// it to the provided TraceFileWriter.
+// Converts the samples |module| gathered over the given period to a
+// TraceSampleData buffer and outputs it to the provided TraceFileWriter.
 bool WriteTraceSampleDataRecord(uint64 sampling_interval_in_cycles,
                                 const SampledModuleCache::Module* module,
+                                const std::vector<ULONG>& samples,
+                                uint64 sampling_start_time,
+                                uint64 sampling_end_time,
                                 TraceFileWriter* writer) {
   DCHECK(module != NULL);
   DCHECK(writer != NULL);
 
-  const ULONG* buckets = module->profiler().buckets().data();
-  size_t bucket_count = module->profiler().buckets().size();
+  const ULONG* buckets = samples.data();
+  size_t bucket_count = samples.size();
   DCHECK_LT(0u, bucket_count);
 
   // Calculate the size of the buffer required to store the samples.
@@ -555,8 +700,8 @@ bool WriteTraceSampleDataRecord(uint64 sampling_interval_in_cycles,
   data->bucket_size = 1 << module->log2_bucket_size();
   data->bucket_start = reinterpret_cast<ModuleAddr>(module->buckets_begin());
   data->bucket_count = bucket_count;
-  data->sampling_start_time = module->profiling_start_time();
-  data->sampling_end_time = module->profiling_stop_time();
+  data->sampling_start_time = sampling_start_time;
+  data->sampling_end_time = sampling_end_time;
   data->sampling_interval = sampling_interval_in_cycles;
 
   // Copy the samples into the buffer.
@@ -568,15 +713,52 @@ bool WriteTraceSampleDataRecord(uint64 sampling_interval_in_cycles,
   return true;
 }
 
+// Suspends a thread and walks its stack. Returns false if the thread could not
+// be sampled, e.g. because it has since exited.
+bool SampleThreadStack(DWORD thread_id,
+                       StackWalker* walker,
+                       StackWalker::Frames* frames) {
+  DCHECK(walker != NULL);
+  DCHECK(frames != NULL);
+
+  const DWORD kDesiredAccess = THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT;
+  base::win::ScopedHandle thread(
+      ::OpenThread(kDesiredAccess, FALSE /* inherit_handle */, thread_id));
+  if (!thread.IsValid())
+    return false;
+
+  if (::SuspendThread(thread.Get()) == static_cast<DWORD>(-1))
+    return false;
+
+  // The stack is walked while the thread is suspended, so that it doesn't
+  // change under our feet.
+  bool sampled = false;
+  CONTEXT context = {};
+  context.ContextFlags = CONTEXT_CONTROL;
+  if (::GetThreadContext(thread.Get(), &context)) {
+    walker->Walk(context.Eip, context.Esp, context.Ebp, frames);
+    sampled = true;
+  }
+
+  ::ResumeThread(thread.Get());
+  return sampled;
+}
+
 }  // namespace
 
 const char SamplerApp::kBlacklistPids[] = "blacklist-pids";
 const char SamplerApp::kBucketSize[] = "bucket-size";
+const char SamplerApp::kFlushInterval[] = "flush-interval";
+const char SamplerApp::kMaxBucketCount[] = "max-buckets";
 const char SamplerApp::kPids[] = "pids";
+const char SamplerApp::kProcessNames[] = "process-names";
+const char SamplerApp::kSampleStacks[] = "sample-stacks";
 const char SamplerApp::kSamplingInterval[] = "sampling-interval";
+const char SamplerApp::kStackSamplingRate[] = "stack-sampling-rate";
 const char SamplerApp::kOutputDir[] = "output-dir";
 
 const size_t SamplerApp::kDefaultLog2BucketSize = 2;
+const size_t SamplerApp::kDefaultStackSamplingRate = 100;
 
 base::Lock SamplerApp::console_ctrl_lock_;
 SamplerApp* SamplerApp::console_ctrl_owner_ = NULL;
@@ -585,12 +767,24 @@ SamplerApp::SamplerApp()
     : common::AppImplBase("Sampler"),
       blacklist_pids_(true),
       log2_bucket_size_(kDefaultLog2BucketSize),
+      max_bucket_count_(0),
       sampling_interval_(),
+      flush_interval_(),
+      sample_stacks_(false),
+      stack_sampling_rate_(kDefaultStackSamplingRate),
       running_(true),
-      sampling_interval_in_cycles_(0) {
+      sampling_interval_in_cycles_(0),
+      stack_sampling_interval_in_cycles_(0) {
 }
 
 SamplerApp::~SamplerApp() {
+  TraceFileMap::iterator it = trace_files_.begin();
+  for (; it != trace_files_.end(); ++it)
+    delete it->second;
+
+  ProcessStacksMap::iterator stacks_it = process_stacks_.begin();
+  for (; stacks_it != process_stacks_.end(); ++stacks_it)
+    delete stacks_it->second;
 }
 
 bool SamplerApp::ParseCommandLine(const CommandLine* command_line) {
@@ -601,9 +795,13 @@ bool SamplerApp::ParseCommandLine(const CommandLine* command_line) {
 
   // Parse the profiler parameters.
   if (!ParseBucketSize(command_line, &log2_bucket_size_) ||
-      !ParseSamplingInterval(command_line, &sampling_interval_)) {
+      !ParseMaxBucketCount(command_line, &max_bucket_count_) ||
+      !ParseSamplingInterval(command_line, &sampling_interval_) ||
+      !ParseFlushInterval(command_line, &flush_interval_) ||
+      !ParseStackSamplingRate(command_line, &stack_sampling_rate_)) {
     return PrintUsage(command_line->GetProgram(), "");
   }
+  sample_stacks_ = command_line->HasSwitch(kSampleStacks);
 
   // By default we set up an empty PID blacklist. This means that all PIDs
   // will be profiled.
@@ -615,6 +813,11 @@ bool SamplerApp::ParseCommandLine(const CommandLine* command_line) {
     blacklist_pids_ = command_line->HasSwitch(kBlacklistPids);
   }
 
+  if (command_line->HasSwitch(kProcessNames)) {
+    if (!ParseProcessNames(command_line->GetSwitchValueNative(kProcessNames)))
+      return PrintUsage(command_line->GetProgram(), "");
+  }
+
   output_dir_ = command_line->GetSwitchValuePath(kOutputDir);
 
   const CommandLine::StringVector& args = command_line->GetArgs();
@@ -693,8 +896,11 @@ int SamplerApp::RunImpl() {
   double interval_in_seconds = sampling_interval_.InSecondsF();
   sampling_interval_in_cycles_ =
       interval_in_seconds * clock_info.tsc_info.frequency;
+  stack_sampling_interval_in_cycles_ =
+      clock_info.tsc_info.frequency / stack_sampling_rate_;
 
   SampledModuleCache cache(log2_bucket_size_);
+  cache.set_max_bucket_count(max_bucket_count_);
   cache.set_dead_module_callback(
       base::Bind(&SamplerApp::OnDeadModule, base::Unretained(this)));
 
@@ -702,6 +908,10 @@ int SamplerApp::RunImpl() {
   size_t process_count = 0;
   size_t module_count = 0;
 
+  // The time at which the samples are next flushed, if they are flushed
+  // periodically.
+  base::TimeTicks next_flush_time = base::TimeTicks::Now() + flush_interval_;
+
   // Sit in a loop, actively monitoring running processes.
   while (running()) {
     // Mark all profiling module as dead. If they aren't remarked as alive after
@@ -751,14 +961,24 @@ int SamplerApp::RunImpl() {
       // If we get here the process corresponding to this PID needs to be
       // examined.
       StartProfilingCallback callback = base::Bind(
-          &SamplerApp::OnStartProfiling, base::Unretained(this));
-      if (!InspectProcessModules(pid, module_sigs_, callback, &cache))
+          &SamplerApp::OnNewModule, base::Unretained(this));
+      if (!InspectProcessModules(pid, process_names_, module_sigs_, callback,
+                                 &cache)) {
         return 1;
+      }
     }
 
     // Remove any profiled modules that are 'dead'. This invokes the callback
     // and causes the profile information to be written to a trace file.
     cache.RemoveDeadModules();
+    CloseDeadTraceFiles(cache);
+
+    // Write out the samples gathered since the last flush, if it's time.
+    if (flush_interval_ > base::TimeDelta() &&
+        base::TimeTicks::Now() >= next_flush_time) {
+      FlushSamples(&cache);
+      next_flush_time = base::TimeTicks::Now() + flush_interval_;
+    }
 
     // Count the number of actively profiled modules and processes.
     size_t new_process_count = cache.processes().size();
@@ -780,13 +1000,15 @@ int SamplerApp::RunImpl() {
 
     // We poll every second so as not to consume too much CPU time, but to not
     // get caught too easily by PID reuse.
-    ::Sleep(1000);
+    WaitForNextPoll();
   }
 
   // Mark all modules as dead and remove them. This will clean up any in
   // progress profiling data.
   cache.MarkAllModulesDead();
   cache.RemoveDeadModules();
+  CloseDeadTraceFiles(cache);
+  DCHECK(trace_files_.empty());
 
   return 0;
 }
@@ -831,42 +1053,276 @@ bool SamplerApp::ParsePids(const std::string& pids) {
   return true;
 }
 
+bool SamplerApp::ParseProcessNames(const std::wstring& process_names) {
+  std::vector<std::wstring> split;
+  base::SplitString(process_names, L',', &split);
+
+  for (size_t i = 0; i < split.size(); ++i) {
+    std::wstring s;
+    ::TrimWhitespace(split[i], TRIM_ALL, &s);
+
+    // Skip empty strings.
+    if (s.empty())
+      continue;
+
+    StringToLowerASCII(&s);
+    process_names_.insert(s);
+  }
+
+  if (process_names_.empty()) {
+    LOG(ERROR) << "--" << kProcessNames << " must not be empty.";
+    return false;
+  }
+
+  return true;
+}
+
+void SamplerApp::OnNewModule(const SampledModuleCache::Module* module) {
+  DCHECK(module != NULL);
+
+  // Announce the module, which ties the samples that follow to it.
+  TraceFileWriter* writer = GetTraceFile(module->process());
+  if (writer != NULL)
+    WriteTraceModuleDataRecord(module, writer);
+
+  // Get the FPO data of the module, needed to walk through the frames of its
+  // functions that don't keep a frame pointer.
+  if (sample_stacks_) {
+    ProcessStacks* stacks = GetProcessStacks(module->process());
+    uint32 base = reinterpret_cast<uint32>(module->module());
+    base::FilePath pdb_path;
+    scoped_ptr<FpoTable> fpo_table(new FpoTable());
+    if (pe::FindPdbForModule(module->module_path(), &pdb_path) &&
+        !pdb_path.empty() && fpo_table->Init(pdb_path)) {
+      stacks->walker.AddModule(base, module->module_size(), fpo_table.get());
+      stacks->fpo_tables[base] = fpo_table.release();
+    } else {
+      LOG(WARNING) << "No FPO data for \"" << module->module_path().value()
+                   << "\", its stacks are walked with frame pointers only.";
+    }
+  }
+
+  // Invoke our testing seam callback.
+  OnStartProfiling(module);
+}
+
 void SamplerApp::OnDeadModule(const SampledModuleCache::Module* module) {
   DCHECK(module != NULL);
 
   // Invoke our testing seam callback.
   OnStopProfiling(module);
 
-  const SampledModuleCache::Process* process = module->process();
+  // Forget the FPO data of the module, as its address range may be reused.
+  ProcessStacksMap::iterator stacks_it =
+      process_stacks_.find(module->process()->pid());
+  if (stacks_it != process_stacks_.end()) {
+    ProcessStacks* stacks = stacks_it->second;
+    uint32 base = reinterpret_cast<uint32>(module->module());
+    stacks->walker.RemoveModule(base);
+    ProcessStacks::FpoTableMap::iterator fpo_it =
+        stacks->fpo_tables.find(base);
+    if (fpo_it != stacks->fpo_tables.end()) {
+      delete fpo_it->second;
+      stacks->fpo_tables.erase(fpo_it);
+    }
+  }
+
+  TraceFileWriter* writer = GetTraceFile(module->process());
+  if (writer == NULL)
+    return;
+
+  LOG(INFO) << "Writing module samples to \"" << writer->path().value()
+            << "\".";
+
+  // Only the samples gathered since the last flush remain to be written.
+  std::vector<ULONG> samples;
+  module->GetUnflushedSamples(&samples);
+  WriteTraceSampleDataRecord(sampling_interval_in_cycles_, module, samples,
+                             module->last_flush_time(),
+                             module->profiling_stop_time(), writer);
+}
+
+void SamplerApp::FlushSamples(SampledModuleCache* cache) {
+  DCHECK(cache != NULL);
+
+  std::vector<ULONG> samples;
+  SampledModuleCache::ProcessMap::const_iterator proc_it =
+      cache->processes().begin();
+  for (; proc_it != cache->processes().end(); ++proc_it) {
+    SampledModuleCache::Process* process = proc_it->second;
+    TraceFileWriter* writer = GetTraceFile(process);
+    if (writer == NULL)
+      continue;
+
+    SampledModuleCache::Process::ModuleMap::iterator mod_it =
+        process->modules().begin();
+    for (; mod_it != process->modules().end(); ++mod_it) {
+      SampledModuleCache::Module* module = mod_it->second;
+      uint64 start_time = 0;
+      uint64 end_time = 0;
+      module->FlushSamples(&samples, &start_time, &end_time);
+      WriteTraceSampleDataRecord(sampling_interval_in_cycles_, module,
+                                 samples, start_time, end_time, writer);
+    }
+
+    ProcessStacksMap::iterator stacks_it = process_stacks_.find(proc_it->first);
+    if (stacks_it != process_stacks_.end())
+      FlushStacks(stacks_it->second, writer);
+  }
+}
+
+TraceFileWriter* SamplerApp::GetTraceFile(
+    const SampledModuleCache::Process* process) {
   DCHECK(process != NULL);
 
+  TraceFileMap::iterator it = trace_files_.find(process->pid());
+  if (it != trace_files_.end())
+    return it->second;
+
   base::FilePath basename = TraceFileWriter::GenerateTraceFileBaseName(
           process->process_info());
   base::FilePath trace_file_path = output_dir_.Append(basename);
 
-  LOG(INFO) << "Writing module samples to \"" << trace_file_path.value()
-            << "\".";
+  scoped_ptr<TraceFileWriter> writer(new TraceFileWriter());
+  if (!writer->Open(trace_file_path))
+    return NULL;
+  if (!writer->WriteHeader(process->process_info()))
+    return NULL;
 
-  // TODO(chrisha): If we deal with processes with multiple profiled modules
-  //     or repeatedly loaded and unloaded modules, we could persist a trace
-  //     file writer for each process and use it repeatedly.
+  trace_files_.insert(std::make_pair(process->pid(), writer.get()));
+  return writer.release();
+}
 
-  TraceFileWriter writer;
-  if (!writer.Open(trace_file_path))
-    return;
+void SamplerApp::CloseDeadTraceFiles(const SampledModuleCache& cache) {
+  // Write out the stacks of the dead processes, while their trace files are
+  // still open.
+  ProcessStacksMap::iterator stacks_it = process_stacks_.begin();
+  while (stacks_it != process_stacks_.end()) {
+    ProcessStacksMap::iterator next_stacks_it = stacks_it;
+    ++next_stacks_it;
+
+    if (cache.processes().find(stacks_it->first) == cache.processes().end()) {
+      TraceFileMap::iterator file_it = trace_files_.find(stacks_it->first);
+      if (file_it != trace_files_.end())
+        FlushStacks(stacks_it->second, file_it->second);
+      delete stacks_it->second;
+      process_stacks_.erase(stacks_it);
+    }
+
+    stacks_it = next_stacks_it;
+  }
+
+  TraceFileMap::iterator it = trace_files_.begin();
+  while (it != trace_files_.end()) {
+    TraceFileMap::iterator next_it = it;
+    ++next_it;
+
+    if (cache.processes().find(it->first) == cache.processes().end()) {
+      it->second->Close();
+      delete it->second;
+      trace_files_.erase(it);
+    }
+
+    it = next_it;
+  }
+}
 
-  if (!writer.WriteHeader(process->process_info()))
+SamplerApp::ProcessStacks* SamplerApp::GetProcessStacks(
+    const SampledModuleCache::Process* process) {
+  DCHECK(process != NULL);
+
+  ProcessStacksMap::iterator it = process_stacks_.find(process->pid());
+  if (it != process_stacks_.end())
+    return it->second;
+
+  ProcessStacks* stacks = new ProcessStacks(process->process());
+  process_stacks_.insert(std::make_pair(process->pid(), stacks));
+  return stacks;
+}
+
+void SamplerApp::SampleStacks() {
+  if (process_stacks_.empty())
     return;
 
-  if (!WriteTraceModuleDataRecord(module, &writer))
+  base::win::ScopedHandle snapshot(
+      ::CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0));
+  if (!snapshot.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "CreateToolhelp32Snapshot failed: " << com::LogWe(error);
     return;
+  }
+
+  // Suspending a thread of our own process could deadlock the walk, e.g. if
+  // the thread holds the heap lock.
+  DWORD self_pid = ::GetCurrentProcessId();
 
-  if (!WriteTraceSampleDataRecord(sampling_interval_in_cycles_, module,
-                                  &writer)) {
+  // The frames are reserved up front, so that walking a stack doesn't
+  // allocate.
+  StackWalker::Frames frames;
+  frames.reserve(StackWalker::kMaxFrames);
+
+  THREADENTRY32 entry = {};
+  entry.dwSize = sizeof(entry);
+  BOOL found = ::Thread32First(snapshot.Get(), &entry);
+  for (; found; found = ::Thread32Next(snapshot.Get(), &entry)) {
+    if (entry.th32OwnerProcessID == self_pid)
+      continue;
+
+    ProcessStacksMap::iterator it =
+        process_stacks_.find(entry.th32OwnerProcessID);
+    if (it == process_stacks_.end())
+      continue;
+
+    ProcessStacks* stacks = it->second;
+    if (SampleThreadStack(entry.th32ThreadID, &stacks->walker, &frames))
+      stacks->table.AddSample(frames);
+  }
+}
+
+void SamplerApp::FlushStacks(ProcessStacks* stacks, TraceFileWriter* writer) {
+  DCHECK(stacks != NULL);
+  DCHECK(writer != NULL);
+
+  uint64 now = trace::common::GetTsc();
+  std::vector<uint8> buffer;
+  if (stacks->table.Flush(stacks->last_flush_time, now,
+                          stack_sampling_interval_in_cycles_, &buffer)) {
+    WriteTraceRecord(reinterpret_cast<const TraceSampleStacks*>(&buffer[0]),
+                     buffer.size(), TRACE_SAMPLE_STACKS, writer);
+  }
+  stacks->last_flush_time = now;
+}
+
+void SamplerApp::WaitForNextPoll() {
+  const base::TimeDelta kPollInterval = base::TimeDelta::FromSeconds(1);
+  if (!sample_stacks_) {
+    ::Sleep(kPollInterval.InMilliseconds());
     return;
   }
 
-  return;
+  const base::TimeDelta kStackSamplingPeriod =
+      base::TimeDelta::FromMicroseconds(
+          base::Time::kMicrosecondsPerSecond / stack_sampling_rate_);
+  base::TimeTicks poll_time = base::TimeTicks::Now() + kPollInterval;
+  while (running()) {
+    SampleStacks();
+
+    base::TimeTicks now = base::TimeTicks::Now();
+    if (now >= poll_time)
+      break;
+    base::TimeDelta delay = std::min(kStackSamplingPeriod, poll_time - now);
+    ::Sleep(delay.InMilliseconds());
+  }
+}
+
+SamplerApp::ProcessStacks::ProcessStacks(HANDLE process)
+    : walker(process), last_flush_time(trace::common::GetTsc()) {
+}
+
+SamplerApp::ProcessStacks::~ProcessStacks() {
+  FpoTableMap::iterator it = fpo_tables.begin();
+  for (; it != fpo_tables.end(); ++it)
+    delete it->second;
 }
 
 bool SamplerApp::GetModuleSignature(
@@ -14,16 +14,25 @@
 //
 // Declares the Sampler applications. This is an application for sampling
 // profiling modules. It can profile multiple uninstrumented modules across
-// multiple processes.
+// multiple processes, selected by PID or by executable name. The samples of
+// long-running processes can be flushed periodically, as histograms of the
+// samples gathered since the previous flush. The call stacks of the threads
+// of the profiled processes can also be sampled, by periodically suspending
+// them and walking their stacks.
 #ifndef SYZYGY_SAMPLER_SAMPLER_APP_H_
 #define SYZYGY_SAMPLER_SAMPLER_APP_H_
 
+#include <map>
 #include <set>
 
 #include "base/time.h"
 #include "base/files/file_path.h"
 #include "syzygy/common/application.h"
+#include "syzygy/sampler/fpo_table.h"
 #include "syzygy/sampler/sampled_module_cache.h"
+#include "syzygy/sampler/sampled_stack_table.h"
+#include "syzygy/sampler/stack_walker.h"
+#include "syzygy/trace/service/trace_file_writer.h"
 
 namespace sampler {
 
@@ -46,19 +55,27 @@ class SamplerApp : public common::AppImplBase {
   // @{
   static const char kBlacklistPids[];
   static const char kBucketSize[];
+  static const char kFlushInterval[];
+  static const char kMaxBucketCount[];
   static const char kPids[];
+  static const char kProcessNames[];
+  static const char kSampleStacks[];
   static const char kSamplingInterval[];
+  static const char kStackSamplingRate[];
   static const char kOutputDir[];
   // @}
 
   // @name Default command-line values.
   // @{
   static const size_t kDefaultLog2BucketSize;
+  static const size_t kDefaultStackSamplingRate;
   // @}
 
   // These are exposed for use by anonymous helper functions.
   struct ModuleSignature;
+  struct ProcessStacks;
   typedef std::set<ModuleSignature> ModuleSignatureSet;
+  typedef std::set<std::wstring> ProcessNameSet;
 
  protected:
   // Inner implementation of Run().
@@ -83,11 +100,57 @@ class SamplerApp : public common::AppImplBase {
   // @returns true on success, false otherwise.
   bool ParsePids(const std::string& pids);
 
+  // Parses a comma-separated list of executable names and populates
+  // process_names_.
+  // @param process_names A comma-separated list of executable names.
+  // @returns true on success, false otherwise.
+  bool ParseProcessNames(const std::wstring& process_names);
+
+  // The callback that is invoked for modules once we have started profiling
+  // them. Announces the module in the trace file of its process.
+  // @param module The module that has just started profiling.
+  void OnNewModule(const SampledModuleCache::Module* module);
+
   // The callback that is invoked for modules once we have finished profiling
-  // them.
+  // them. Writes the samples that weren't flushed yet.
   // @param module The module that has just finished profiling.
   void OnDeadModule(const SampledModuleCache::Module* module);
 
+  // Writes the samples gathered since the last flush for every module being
+  // profiled.
+  // @param cache The cache of the modules being profiled.
+  void FlushSamples(SampledModuleCache* cache);
+
+  // Gets the trace file of a process, creating it if need be.
+  // @param process The process whose trace file is returned.
+  // @returns the trace file writer, or NULL on failure.
+  trace::service::TraceFileWriter* GetTraceFile(
+      const SampledModuleCache::Process* process);
+
+  // Closes the trace files of the processes that are no longer profiled,
+  // after writing the stacks that weren't flushed yet.
+  // @param cache The cache of the modules being profiled.
+  void CloseDeadTraceFiles(const SampledModuleCache& cache);
+
+  // Gets the stack sampling state of a process, creating it if need be.
+  // @param process The process whose state is returned.
+  // @returns the stack sampling state.
+  ProcessStacks* GetProcessStacks(const SampledModuleCache::Process* process);
+
+  // Suspends every thread of the profiled processes in turn, and records a
+  // sample of its stack.
+  void SampleStacks();
+
+  // Writes the stacks sampled in a process since the last flush.
+  // @param stacks The stack sampling state of the process.
+  // @param writer The trace file of the process.
+  void FlushStacks(ProcessStacks* stacks,
+                   trace::service::TraceFileWriter* writer);
+
+  // Waits until it's time to poll the running processes again, sampling
+  // stacks in the meantime if requested.
+  void WaitForNextPoll();
+
   // Initializes a ModuleSignature given a path. Logs an error on failure.
   // @param module The path to the module.
   // @param sig The signature object to be initialized.
@@ -115,10 +178,24 @@ class SamplerApp : public common::AppImplBase {
   // is a whitelist.
   bool blacklist_pids_;
 
+  // Lower-case executable names. If not empty, only the processes running one
+  // of these executables are profiled, in addition to the PID filtering.
+  ProcessNameSet process_names_;
+
   // Sampling profiler parameters.
   size_t log2_bucket_size_;
+  size_t max_bucket_count_;
   base::TimeDelta sampling_interval_;
 
+  // The interval between flushes of the samples, or zero if the samples are
+  // only written once a module stops being profiled.
+  base::TimeDelta flush_interval_;
+
+  // Stack sampling parameters. The stacks are sampled at the given number of
+  // times per second if sample_stacks_ is true.
+  bool sample_stacks_;
+  size_t stack_sampling_rate_;
+
   // The output directory where trace files will be written.
   base::FilePath output_dir_;
 
@@ -134,8 +211,18 @@ class SamplerApp : public common::AppImplBase {
   // @name Internal state and calculations.
   // @{
   uint64 sampling_interval_in_cycles_;
+  uint64 stack_sampling_interval_in_cycles_;
   // @}
 
+  // The trace files of the profiled processes, keyed by PID. These are kept
+  // open as long as a module of the process is being profiled.
+  typedef std::map<DWORD, trace::service::TraceFileWriter*> TraceFileMap;
+  TraceFileMap trace_files_;
+
+  // The stack sampling state of the profiled processes, keyed by PID.
+  typedef std::map<DWORD, ProcessStacks*> ProcessStacksMap;
+  ProcessStacksMap process_stacks_;
+
   // Only one instance of this class can register for console control messages,
   // on a first-come first-serve basis.
   static base::Lock console_ctrl_lock_;
@@ -152,6 +239,26 @@ struct SamplerApp::ModuleSignature {
   bool operator<(const ModuleSignature& rhs) const;
 };
 
+// The stack sampling state of a profiled process.
+struct SamplerApp::ProcessStacks {
+  explicit ProcessStacks(HANDLE process);
+  ~ProcessStacks();
+
+  StackWalker walker;
+  SampledStackTable table;
+
+  // The FPO data of the profiled modules of the process, keyed by base
+  // address. These are owned by this object.
+  typedef std::map<uint32, FpoTable*> FpoTableMap;
+  FpoTableMap fpo_tables;
+
+  // The time of the last flush of the stacks.
+  uint64 last_flush_time;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ProcessStacks);
+};
+
 }  // namespace sampler
 
 #endif  // SYZYGY_SAMPLER_SAMPLER_APP_H_
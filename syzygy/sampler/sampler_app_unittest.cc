@@ -57,7 +57,12 @@ class TestSamplerApp : public SamplerApp {
   using SamplerApp::output_dir_;
   using SamplerApp::module_sigs_;
   using SamplerApp::log2_bucket_size_;
+  using SamplerApp::max_bucket_count_;
   using SamplerApp::sampling_interval_;
+  using SamplerApp::flush_interval_;
+  using SamplerApp::process_names_;
+  using SamplerApp::sample_stacks_;
+  using SamplerApp::stack_sampling_rate_;
   using SamplerApp::running_;
 
   void WaitUntilStartProfiling() {
@@ -301,6 +306,9 @@ TEST_F(SamplerAppTest, ParseValidBucketSizeMinimal) {
   EXPECT_EQ(3u, impl_.log2_bucket_size_);
   EXPECT_EQ(kDefaultSamplingInterval, impl_.sampling_interval_);
   EXPECT_TRUE(impl_.output_dir_.empty());
+  EXPECT_EQ(0u, impl_.max_bucket_count_);
+  EXPECT_EQ(base::TimeDelta(), impl_.flush_interval_);
+  EXPECT_TRUE(impl_.process_names_.empty());
 }
 
 TEST_F(SamplerAppTest, ParseTooSmallSamplingIntervalFails) {
@@ -414,6 +422,61 @@ TEST_F(SamplerAppTest, ParseFullBlacklist) {
   EXPECT_EQ(base::FilePath(L"foo"), impl_.output_dir_);
 }
 
+TEST_F(SamplerAppTest, ParseInvalidFlushIntervalFails) {
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kFlushInterval, "-1");
+  cmd_line_.AppendArgPath(test_dll_path);
+  ASSERT_FALSE(impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(SamplerAppTest, ParseInvalidMaxBucketCountFails) {
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kMaxBucketCount, "0");
+  cmd_line_.AppendArgPath(test_dll_path);
+  ASSERT_FALSE(impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(SamplerAppTest, ParseEmptyProcessNamesFails) {
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kProcessNames, " , ");
+  cmd_line_.AppendArgPath(test_dll_path);
+  ASSERT_FALSE(impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(SamplerAppTest, ParseFleetOptions) {
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kFlushInterval, "2.5");
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kMaxBucketCount, "65536");
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kProcessNames,
+                              "Chrome.exe, foo.EXE,");
+  cmd_line_.AppendArgPath(test_dll_path);
+  ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
+
+  EXPECT_TRUE(impl_.pids_.empty());
+  EXPECT_TRUE(impl_.blacklist_pids_);
+  EXPECT_EQ(base::TimeDelta::FromMilliseconds(2500), impl_.flush_interval_);
+  EXPECT_EQ(65536u, impl_.max_bucket_count_);
+  EXPECT_THAT(impl_.process_names_,
+              testing::ElementsAre(L"chrome.exe", L"foo.exe"));
+}
+
+TEST_F(SamplerAppTest, ParseInvalidStackSamplingRateFails) {
+  cmd_line_.AppendSwitch(TestSamplerApp::kSampleStacks);
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kStackSamplingRate, "2000");
+  cmd_line_.AppendArgPath(test_dll_path);
+  ASSERT_FALSE(impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(SamplerAppTest, ParseStackSamplingOptions) {
+  cmd_line_.AppendArgPath(test_dll_path);
+  ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_FALSE(impl_.sample_stacks_);
+  EXPECT_EQ(TestSamplerApp::kDefaultStackSamplingRate,
+            impl_.stack_sampling_rate_);
+
+  cmd_line_.AppendSwitch(TestSamplerApp::kSampleStacks);
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kStackSamplingRate, "250");
+  ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(impl_.sample_stacks_);
+  EXPECT_EQ(250u, impl_.stack_sampling_rate_);
+}
+
 TEST_F(SamplerAppTest, SampleSelfPidWhitelist) {
   cmd_line_.AppendSwitchASCII(TestSamplerApp::kPids,
       base::StringPrintf("%d", ::GetCurrentProcessId()));
@@ -0,0 +1,110 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/sampler/stack_walker.h"
+
+#include "base/logging.h"
+
+namespace sampler {
+
+StackWalker::StackWalker(HANDLE process) : process_(process) {
+}
+
+void StackWalker::AddModule(uint32 base,
+                            uint32 size,
+                            const FpoTable* fpo_table) {
+  DCHECK(fpo_table != NULL);
+  ModuleFpoData data = { size, fpo_table };
+  modules_[base] = data;
+}
+
+void StackWalker::RemoveModule(uint32 base) {
+  modules_.erase(base);
+}
+
+void StackWalker::Walk(uint32 eip, uint32 esp, uint32 ebp, Frames* frames) {
+  DCHECK(frames != NULL);
+
+  frames->clear();
+  frames->push_back(eip);
+
+  uint32 pc = eip;
+  while (frames->size() < kMaxFrames) {
+    // A return address refers to the instruction following the call, which
+    // may belong to the next function when the call ends its caller.
+    uint32 code_address = frames->size() == 1 ? pc : pc - 1;
+    const FPO_DATA* fpo_data = FindFpoData(code_address);
+
+    uint32 return_address_location = 0;
+    uint32 next_ebp = ebp;
+    if (fpo_data != NULL && !fpo_data->fUseBP) {
+      // The return address sits right above the locals and the registers
+      // saved by the function. The frame pointer is left alone, unless it is
+      // one of the saved registers, which we can't tell.
+      return_address_location =
+          esp + sizeof(uint32) * (fpo_data->cdwLocals + fpo_data->cbRegs);
+    } else {
+      // The function keeps a frame pointer, which refers to the frame pointer
+      // of its caller, right below the return address.
+      if (ebp < esp || ebp % sizeof(uint32) != 0)
+        break;
+      if (!ReadStackSlot(ebp, &next_ebp))
+        break;
+      return_address_location = ebp + sizeof(uint32);
+    }
+
+    uint32 return_address = 0;
+    if (!ReadStackSlot(return_address_location, &return_address) ||
+        return_address == 0) {
+      break;
+    }
+
+    // The stack grows downwards, so the walk must move upwards.
+    uint32 next_esp = return_address_location + sizeof(uint32);
+    if (next_esp <= esp)
+      break;
+
+    frames->push_back(return_address);
+    pc = return_address;
+    esp = next_esp;
+    ebp = next_ebp;
+  }
+}
+
+bool StackWalker::ReadStackSlot(uint32 address, uint32* value) {
+  DCHECK(value != NULL);
+
+  SIZE_T bytes_read = 0;
+  if (!::ReadProcessMemory(process_,
+                           reinterpret_cast<const void*>(address),
+                           value,
+                           sizeof(*value),
+                           &bytes_read) ||
+      bytes_read != sizeof(*value)) {
+    return false;
+  }
+  return true;
+}
+
+const FPO_DATA* StackWalker::FindFpoData(uint32 address) const {
+  ModuleMap::const_iterator it = modules_.upper_bound(address);
+  if (it == modules_.begin())
+    return NULL;
+  --it;
+  if (address - it->first >= it->second.size)
+    return NULL;
+  return it->second.fpo_table->Find(address - it->first);
+}
+
+}  // namespace sampler
@@ -0,0 +1,99 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares StackWalker, which walks the stacks of the suspended threads of
+// another process for the stack sampling mode of the sampler.
+//
+// The walk is meant to be cheap rather than exact: it follows the chain of
+// frame pointers, and only falls back to the frame pointer omission data of
+// a module for the functions that have some. The frame of an FPO function is
+// assumed to be fully set up, so a thread sampled in a prologue or epilogue
+// may yield a truncated stack.
+
+#ifndef SYZYGY_SAMPLER_STACK_WALKER_H_
+#define SYZYGY_SAMPLER_STACK_WALKER_H_
+
+#include <windows.h>
+#include <map>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "syzygy/sampler/fpo_table.h"
+
+namespace sampler {
+
+class StackWalker {
+ public:
+  // The frames of a stack, innermost first. The innermost frame is the
+  // address of the current instruction, the others are return addresses.
+  typedef std::vector<uint32> Frames;
+
+  // The maximum number of frames a walk produces.
+  static const size_t kMaxFrames = 62;
+
+  // Constructor.
+  // @param process A handle to the process whose stacks are walked. This
+  //     must have PROCESS_VM_READ access, and must outlive this object.
+  explicit StackWalker(HANDLE process);
+  virtual ~StackWalker() { }
+
+  // Registers the FPO data of a module loaded in the process.
+  // @param base The base address of the module.
+  // @param size The size of the module.
+  // @param fpo_table The FPO data of the module. This must outlive its
+  //     registration.
+  void AddModule(uint32 base, uint32 size, const FpoTable* fpo_table);
+
+  // Unregisters a module.
+  // @param base The base address of the module.
+  void RemoveModule(uint32 base);
+
+  // Walks the stack of a suspended thread.
+  // @param eip The instruction pointer of the thread.
+  // @param esp The stack pointer of the thread.
+  // @param ebp The frame pointer of the thread.
+  // @param frames Receives the frames of the stack.
+  void Walk(uint32 eip, uint32 esp, uint32 ebp, Frames* frames);
+
+ protected:
+  // Reads a slot of the stack of the process. This is a unittesting seam.
+  // @param address The address of the slot.
+  // @param value Receives the content of the slot.
+  // @returns true on success, false otherwise.
+  virtual bool ReadStackSlot(uint32 address, uint32* value);
+
+  // Finds the FPO data of the function containing a code address.
+  // @param address The code address.
+  // @returns the FPO data, or NULL if there is none.
+  const FPO_DATA* FindFpoData(uint32 address) const;
+
+  // The FPO data of a registered module.
+  struct ModuleFpoData {
+    uint32 size;
+    const FpoTable* fpo_table;
+  };
+
+  // The registered modules, keyed by base address.
+  typedef std::map<uint32, ModuleFpoData> ModuleMap;
+  ModuleMap modules_;
+
+  HANDLE process_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(StackWalker);
+};
+
+}  // namespace sampler
+
+#endif  // SYZYGY_SAMPLER_STACK_WALKER_H_
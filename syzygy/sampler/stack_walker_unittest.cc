@@ -0,0 +1,154 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/sampler/stack_walker.h"
+
+#include "gtest/gtest.h"
+
+namespace sampler {
+
+namespace {
+
+const uint32 kStackBase = 0x00100000;
+const size_t kStackSlots = 256;
+const uint32 kModuleBase = 0x10000000;
+const uint32 kModuleSize = 0x10000;
+
+// A stack walker that walks a fake stack.
+class TestStackWalker : public StackWalker {
+ public:
+  TestStackWalker() : StackWalker(NULL) {
+    ::memset(stack_, 0, sizeof(stack_));
+  }
+
+  // Sets the content of a stack slot.
+  void SetSlot(size_t index, uint32 value) {
+    ASSERT_LT(index, kStackSlots);
+    stack_[index] = value;
+  }
+
+ protected:
+  virtual bool ReadStackSlot(uint32 address, uint32* value) OVERRIDE {
+    if (address < kStackBase || address % sizeof(uint32) != 0)
+      return false;
+    size_t index = (address - kStackBase) / sizeof(uint32);
+    if (index >= kStackSlots)
+      return false;
+    *value = stack_[index];
+    return true;
+  }
+
+ private:
+  uint32 stack_[kStackSlots];
+};
+
+uint32 SlotAddress(size_t index) {
+  return kStackBase + index * sizeof(uint32);
+}
+
+}  // namespace
+
+TEST(StackWalkerTest, WalksFramePointers) {
+  TestStackWalker walker;
+
+  // Three nested frames, each holding the caller's frame pointer followed by
+  // the return address. The outermost frame pointer ends the chain.
+  walker.SetSlot(4, SlotAddress(10));
+  walker.SetSlot(5, 0x20001000);
+  walker.SetSlot(10, SlotAddress(20));
+  walker.SetSlot(11, 0x20002000);
+  walker.SetSlot(20, 0);
+  walker.SetSlot(21, 0x20003000);
+
+  StackWalker::Frames frames;
+  walker.Walk(0x20000000, SlotAddress(2), SlotAddress(4), &frames);
+  ASSERT_EQ(4U, frames.size());
+  EXPECT_EQ(0x20000000U, frames[0]);
+  EXPECT_EQ(0x20001000U, frames[1]);
+  EXPECT_EQ(0x20002000U, frames[2]);
+  EXPECT_EQ(0x20003000U, frames[3]);
+}
+
+TEST(StackWalkerTest, StopsOnCorruptFramePointers) {
+  TestStackWalker walker;
+
+  // The caller's frame pointer refers further down the stack.
+  walker.SetSlot(10, SlotAddress(4));
+  walker.SetSlot(11, 0x20001000);
+  walker.SetSlot(4, SlotAddress(10));
+  walker.SetSlot(5, 0x20002000);
+
+  StackWalker::Frames frames;
+  walker.Walk(0x20000000, SlotAddress(8), SlotAddress(10), &frames);
+  ASSERT_EQ(2U, frames.size());
+  EXPECT_EQ(0x20000000U, frames[0]);
+  EXPECT_EQ(0x20001000U, frames[1]);
+
+  // A frame pointer outside of the stack yields the current frame only.
+  walker.Walk(0x20000000, SlotAddress(8), 0x12345678, &frames);
+  ASSERT_EQ(1U, frames.size());
+}
+
+TEST(StackWalkerTest, UsesFpoData) {
+  // A function with 3 locals and 2 saved registers, and no frame pointer.
+  std::vector<FPO_DATA> entries;
+  FPO_DATA entry = {};
+  entry.ulOffStart = 0x1000;
+  entry.cbProcSize = 0x100;
+  entry.cdwLocals = 3;
+  entry.cbRegs = 2;
+  entries.push_back(entry);
+  FpoTable fpo_table;
+  fpo_table.InitFromEntries(&entries);
+
+  TestStackWalker walker;
+  walker.AddModule(kModuleBase, kModuleSize, &fpo_table);
+
+  // The FPO function was called from a function with a frame pointer, which
+  // was itself called from the FPO function.
+  walker.SetSlot(7, kModuleBase + 0x2000);
+  walker.SetSlot(10, SlotAddress(20));
+  walker.SetSlot(11, kModuleBase + 0x1080);
+  walker.SetSlot(17, 0x20003000);
+
+  StackWalker::Frames frames;
+  walker.Walk(kModuleBase + 0x1010, SlotAddress(2), SlotAddress(10), &frames);
+  ASSERT_EQ(4U, frames.size());
+  EXPECT_EQ(kModuleBase + 0x1010, frames[0]);
+  EXPECT_EQ(kModuleBase + 0x2000, frames[1]);
+  EXPECT_EQ(kModuleBase + 0x1080, frames[2]);
+  EXPECT_EQ(0x20003000U, frames[3]);
+
+  // Without the FPO data the walk follows the frame pointer right away.
+  walker.RemoveModule(kModuleBase);
+  walker.Walk(kModuleBase + 0x1010, SlotAddress(2), SlotAddress(10), &frames);
+  ASSERT_EQ(2U, frames.size());
+  EXPECT_EQ(kModuleBase + 0x1080, frames[1]);
+}
+
+TEST(StackWalkerTest, LimitsTheNumberOfFrames) {
+  TestStackWalker walker;
+
+  // A frame pointer chain that's longer than the walk.
+  for (size_t i = 0; i + 3 < kStackSlots; i += 2) {
+    walker.SetSlot(i, SlotAddress(i + 2));
+    walker.SetSlot(i + 1, 0x20000000 + i);
+  }
+
+  StackWalker::Frames frames;
+  walker.Walk(0x20000000, SlotAddress(0), SlotAddress(0), &frames);
+  EXPECT_EQ(StackWalker::kMaxFrames, frames.size());
+}
+
+}  // namespace sampler
@@ -27,6 +27,7 @@ namespace {
 
 static uint32 kDummyModuleAddress = 0x07000000;
 static uint32 kDummyBucketSize = 4;
+static uint32 kDummyOutsideAddress = 0x00401000;
 
 // Returns the address of 'LabelTestFunc'.
 void GetLabelTestFuncAdddress(const pe::PEFile& test_dll_pe_file,
@@ -95,6 +96,41 @@ void InitializeDummyTraceSampleData(
   sample_data->buckets[index] = 1000;
 }
 
+void InitializeDummyTraceSampleStacks(
+    const trace::common::ClockInfo& clock_info,
+    const pe::PEFile& test_dll_pe_file,
+    std::vector<uint8>* buffer) {
+  pe::PEFile::RelativeAddress function_rva;
+  ASSERT_NO_FATAL_FAILURE(GetLabelTestFuncAdddress(test_dll_pe_file,
+                                                   &function_rva));
+
+  // Initialize a TraceSampleStacks record holding a single stack, sampled
+  // 100 times. Its innermost frame is in 'LabelTestFunc', and its outermost
+  // frame is outside of any module.
+  const uint32 kNumFrames = 2;
+  buffer->resize(FIELD_OFFSET(TraceSampleStacks, stacks) +
+                     sizeof(TraceSampleStack) +
+                     sizeof(ModuleAddr) * kNumFrames);
+  TraceSampleStacks* sample_stacks = reinterpret_cast<TraceSampleStacks*>(
+      buffer->data());
+
+  sample_stacks->sampling_start_time =
+      clock_info.tsc_reference - clock_info.tsc_info.frequency;
+  sample_stacks->sampling_end_time = clock_info.tsc_reference;
+  sample_stacks->sampling_interval = clock_info.tsc_info.frequency / 100;
+  sample_stacks->num_stacks = 1;
+  sample_stacks->num_frames = kNumFrames;
+  sample_stacks->stacks[0].stack_id = 0;
+  sample_stacks->stacks[0].count = 100;
+  sample_stacks->stacks[0].num_frames = kNumFrames;
+
+  ModuleAddr* frames = reinterpret_cast<ModuleAddr*>(
+      sample_stacks->stacks + 1);
+  frames[0] = reinterpret_cast<ModuleAddr>(
+      kDummyModuleAddress + function_rva.value());
+  frames[1] = reinterpret_cast<ModuleAddr>(kDummyOutsideAddress);
+}
+
 }  // namespace
 
 void WriteDummySamplerTraceFile(const base::FilePath& path) {
@@ -149,6 +185,17 @@ void WriteDummySamplerTraceFile(const base::FilePath& path) {
       buffer.size(),
       &writer));
 
+  // Write the sampled stacks.
+  buffer.clear();
+  ASSERT_NO_FATAL_FAILURE(InitializeDummyTraceSampleStacks(
+      clock_info, test_dll_pe_file, &buffer));
+  ASSERT_NO_FATAL_FAILURE(testing::WriteRecord(
+      clock_info.tsc_reference,
+      TraceSampleStacks::kTypeId,
+      buffer.data(),
+      buffer.size(),
+      &writer));
+
   ASSERT_TRUE(writer.Close());
 }
 
@@ -22,8 +22,8 @@
 namespace testing {
 
 // Generates a dummy trace file for test_dll.dll, containing nothing but a
-// single sampling profiler record. Causes an assertion on failure. Should be
-// called via ASSERT_NO_FATAL_FAILURE.
+// single sampling profiler record and a single sampled stacks record. Causes
+// an assertion on failure. Should be called via ASSERT_NO_FATAL_FAILURE.
 // @param path The path where the trace file should be written.
 void WriteDummySamplerTraceFile(const base::FilePath& path);
 
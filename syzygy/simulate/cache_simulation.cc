@@ -0,0 +1,216 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/simulate/cache_simulation.h"
+
+#include <algorithm>
+
+#include "syzygy/core/json_file_writer.h"
+
+namespace simulate {
+
+namespace {
+
+bool OutputCounts(const CacheSimulation::Counts& counts,
+                  core::JSONFileWriter* json_file) {
+  DCHECK(json_file != NULL);
+
+  return json_file->OutputKey("cache_accesses") &&
+      json_file->OutputInteger(counts.cache_accesses) &&
+      json_file->OutputKey("cache_misses") &&
+      json_file->OutputInteger(counts.cache_misses) &&
+      json_file->OutputKey("tlb_accesses") &&
+      json_file->OutputInteger(counts.tlb_accesses) &&
+      json_file->OutputKey("tlb_misses") &&
+      json_file->OutputInteger(counts.tlb_misses);
+}
+
+}  // namespace
+
+SetAssociativeCache::SetAssociativeCache(size_t num_entries,
+                                         size_t associativity)
+    : associativity_(associativity) {
+  DCHECK_LT(0U, associativity);
+  DCHECK_LE(associativity, num_entries);
+  DCHECK_EQ(0U, num_entries % associativity);
+
+  sets_.resize(num_entries / associativity);
+  for (size_t i = 0; i < sets_.size(); ++i)
+    sets_[i].reserve(associativity);
+}
+
+bool SetAssociativeCache::Access(uint32 id) {
+  Set& set = sets_[id % sets_.size()];
+
+  Set::iterator it = std::find(set.begin(), set.end(), id);
+  bool hit = it != set.end();
+  if (!hit) {
+    // Evict the least recently used entry of a full set.
+    if (set.size() == associativity_)
+      set.pop_back();
+    set.push_back(id);
+    it = set.end() - 1;
+  }
+
+  // Move the entry to the front, as the most recently used.
+  std::rotate(set.begin(), it, it + 1);
+  return hit;
+}
+
+void SetAssociativeCache::Flush() {
+  for (size_t i = 0; i < sets_.size(); ++i)
+    sets_[i].clear();
+}
+
+CacheSimulation::CacheSimulation()
+    : cache_line_size_(kDefaultCacheLineSize),
+      cache_size_(kDefaultCacheSize),
+      cache_associativity_(kDefaultCacheAssociativity),
+      tlb_entries_(kDefaultTlbEntries),
+      tlb_associativity_(kDefaultTlbAssociativity),
+      page_size_(0) {
+}
+
+CacheSimulation::~CacheSimulation() {
+}
+
+void CacheSimulation::OnScenarioStarted(const std::string& name) {
+  scenarios_.push_back(ScenarioCounts());
+  scenarios_.back().name = name;
+}
+
+void CacheSimulation::OnProcessStarted(base::Time /*time*/,
+                                       size_t default_page_size) {
+  if (page_size_ == 0) {
+    if (default_page_size != 0)
+      page_size_ = default_page_size;
+    else
+      page_size_ = kDefaultPageSize;
+
+    LOG(INFO) << "Page size set to " << page_size_;
+  }
+
+  if (cache_.get() == NULL) {
+    cache_.reset(new SetAssociativeCache(cache_size_ / cache_line_size_,
+                                         cache_associativity_));
+    tlb_.reset(new SetAssociativeCache(tlb_entries_, tlb_associativity_));
+  }
+
+  // Each process has its own address space, and only starts running once
+  // whatever it could have shared has been evicted.
+  cache_->Flush();
+  tlb_->Flush();
+}
+
+void CacheSimulation::OnFunctionEntry(base::Time /*time*/,
+                                      const Block* block) {
+  DCHECK(block != NULL);
+  DCHECK(cache_.get() != NULL);
+  DCHECK(tlb_.get() != NULL);
+
+  if (block->size() == 0)
+    return;
+
+  const uint32 block_start = block->addr().value();
+  const uint32 block_end = block_start + block->size();
+
+  // Fetch the lines in order, translating the page of each line as it is
+  // fetched.
+  size_t cache_accesses = 0;
+  size_t cache_misses = 0;
+  size_t tlb_accesses = 0;
+  size_t tlb_misses = 0;
+  uint32 last_page = 0;
+  const uint32 kStartLine = block_start / cache_line_size_;
+  const uint32 kEndLine = (block_end - 1) / cache_line_size_ + 1;
+  for (uint32 line = kStartLine; line < kEndLine; ++line) {
+    uint32 page = line * cache_line_size_ / page_size_;
+    if (line == kStartLine || page != last_page) {
+      ++tlb_accesses;
+      if (!tlb_->Access(page))
+        ++tlb_misses;
+      last_page = page;
+    }
+
+    ++cache_accesses;
+    if (!cache_->Access(line))
+      ++cache_misses;
+  }
+
+  AddAccesses(cache_accesses, cache_misses, tlb_accesses, tlb_misses);
+}
+
+bool CacheSimulation::SerializeToJSON(FILE* output, bool pretty_print) {
+  DCHECK(output != NULL);
+  core::JSONFileWriter json_file(output, pretty_print);
+
+  if (!json_file.OpenDict() ||
+      !json_file.OutputKey("cache_line_size") ||
+      !json_file.OutputInteger(cache_line_size_) ||
+      !json_file.OutputKey("cache_size") ||
+      !json_file.OutputInteger(cache_size_) ||
+      !json_file.OutputKey("cache_associativity") ||
+      !json_file.OutputInteger(cache_associativity_) ||
+      !json_file.OutputKey("tlb_entries") ||
+      !json_file.OutputInteger(tlb_entries_) ||
+      !json_file.OutputKey("tlb_associativity") ||
+      !json_file.OutputInteger(tlb_associativity_) ||
+      !json_file.OutputKey("page_size") ||
+      !json_file.OutputInteger(page_size_) ||
+      !OutputCounts(counts_, &json_file)) {
+    return false;
+  }
+
+  if (!scenarios_.empty()) {
+    if (!json_file.OutputKey("scenarios") || !json_file.OpenList())
+      return false;
+    for (size_t i = 0; i < scenarios_.size(); ++i) {
+      if (!json_file.OpenDict() ||
+          !json_file.OutputKey("name") ||
+          !json_file.OutputString(scenarios_[i].name) ||
+          !OutputCounts(scenarios_[i].counts, &json_file) ||
+          !json_file.CloseDict()) {
+        return false;
+      }
+    }
+    if (!json_file.CloseList())
+      return false;
+  }
+
+  if (!json_file.CloseDict())
+    return false;
+
+  DCHECK(json_file.Finished());
+  return true;
+}
+
+void CacheSimulation::AddAccesses(size_t cache_accesses,
+                                  size_t cache_misses,
+                                  size_t tlb_accesses,
+                                  size_t tlb_misses) {
+  counts_.cache_accesses += cache_accesses;
+  counts_.cache_misses += cache_misses;
+  counts_.tlb_accesses += tlb_accesses;
+  counts_.tlb_misses += tlb_misses;
+
+  if (!scenarios_.empty()) {
+    Counts& counts = scenarios_.back().counts;
+    counts.cache_accesses += cache_accesses;
+    counts.cache_misses += cache_misses;
+    counts.tlb_accesses += tlb_accesses;
+    counts.tlb_misses += tlb_misses;
+  }
+}
+
+}  // namespace simulate
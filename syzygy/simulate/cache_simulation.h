@@ -0,0 +1,208 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file declares the CacheSimulation class, which models the instruction
+// cache and the instruction TLB.
+
+#ifndef SYZYGY_SIMULATE_CACHE_SIMULATION_H_
+#define SYZYGY_SIMULATE_CACHE_SIMULATION_H_
+
+#include <string>
+#include <vector>
+
+#include "base/memory/scoped_ptr.h"
+#include "syzygy/simulate/simulation_event_handler.h"
+
+namespace simulate {
+
+// A set-associative cache with a least recently used replacement policy. This
+// models both caches and TLBs, in which case the entries are pages.
+class SetAssociativeCache {
+ public:
+  // Constructs a cache.
+  // @param num_entries the total number of entries of the cache. This must be
+  //     a multiple of @p associativity.
+  // @param associativity the number of entries per set.
+  SetAssociativeCache(size_t num_entries, size_t associativity);
+
+  // Accesses an entry, loading it into the cache if it isn't there yet.
+  // @param id the index of the entry, that is the address divided by the size
+  //     of the entries.
+  // @returns true on a hit, false on a miss.
+  bool Access(uint32 id);
+
+  // Evicts all the entries of the cache.
+  void Flush();
+
+  // @name Accessors
+  // @{
+  size_t num_sets() const { return sets_.size(); }
+  size_t associativity() const { return associativity_; }
+  // @}
+
+ private:
+  // The entries of each set, from the most to the least recently used.
+  typedef std::vector<uint32> Set;
+
+  std::vector<Set> sets_;
+  size_t associativity_;
+
+  DISALLOW_COPY_AND_ASSIGN(SetAssociativeCache);
+};
+
+// An implementation of SimulationEventHandler. CacheSimulation counts the
+// misses of a set-associative instruction cache and instruction TLB, assuming
+// that each function entry executes the whole code block. Comparing these
+// counts for several orderings of the same module shows how well they pack
+// the hot code into cache lines and pages. Sample usage:
+//
+// CacheSimulation simulation;
+//
+// simulation.set_cache_size(0x8000);
+// simulation.set_cache_associativity(8);
+// simulation.OnProcessStarted(time, 0);
+// simulation.OnFunctionEntry(time, block1);
+// simulation.OnFunctionEntry(time, block2);
+// simulation.SerializeToJSON(file, pretty_print);
+//
+// The caches are flushed when a process starts. If the page size isn't set,
+// it is deduced from the trace file data or, if that's not possible, it's set
+// to the default value of 0x1000 (4 KB).
+//
+// When the trace files are grouped in scenarios, the misses of each scenario
+// are also reported.
+class CacheSimulation : public SimulationEventHandler {
+ public:
+  typedef block_graph::BlockGraph::Block Block;
+
+  // The accesses and misses of the caches.
+  struct Counts {
+    Counts()
+        : cache_accesses(0), cache_misses(0), tlb_accesses(0), tlb_misses(0) {
+    }
+
+    size_t cache_accesses;
+    size_t cache_misses;
+    size_t tlb_accesses;
+    size_t tlb_misses;
+  };
+
+  // The counts of a scenario.
+  struct ScenarioCounts {
+    std::string name;
+    Counts counts;
+  };
+  typedef std::vector<ScenarioCounts> ScenarioCountsVector;
+
+  // The default parameters, which are those of a typical x86 core.
+  static const size_t kDefaultCacheLineSize = 64;
+  static const size_t kDefaultCacheSize = 0x8000;
+  static const size_t kDefaultCacheAssociativity = 8;
+  static const size_t kDefaultTlbEntries = 64;
+  static const size_t kDefaultTlbAssociativity = 4;
+  static const size_t kDefaultPageSize = 0x1000;
+
+  CacheSimulation();
+  ~CacheSimulation();
+
+  // @name Accessors
+  // @{
+  size_t cache_line_size() const { return cache_line_size_; }
+  size_t cache_size() const { return cache_size_; }
+  size_t cache_associativity() const { return cache_associativity_; }
+  size_t tlb_entries() const { return tlb_entries_; }
+  size_t tlb_associativity() const { return tlb_associativity_; }
+  size_t page_size() const { return page_size_; }
+  const Counts& counts() const { return counts_; }
+  const ScenarioCountsVector& scenarios() const { return scenarios_; }
+  // @}
+
+  // @name Mutators
+  // These must be called before the simulation starts. The cache size must be
+  // a multiple of the size of a cache set, and the number of TLB entries must
+  // be a multiple of the TLB associativity.
+  // @{
+  void set_cache_line_size(size_t cache_line_size) {
+    DCHECK_LT(0U, cache_line_size);
+    cache_line_size_ = cache_line_size;
+  }
+  void set_cache_size(size_t cache_size) {
+    DCHECK_LT(0U, cache_size);
+    cache_size_ = cache_size;
+  }
+  void set_cache_associativity(size_t cache_associativity) {
+    DCHECK_LT(0U, cache_associativity);
+    cache_associativity_ = cache_associativity;
+  }
+  void set_tlb_entries(size_t tlb_entries) {
+    DCHECK_LT(0U, tlb_entries);
+    tlb_entries_ = tlb_entries;
+  }
+  void set_tlb_associativity(size_t tlb_associativity) {
+    DCHECK_LT(0U, tlb_associativity);
+    tlb_associativity_ = tlb_associativity;
+  }
+  void set_page_size(size_t page_size) {
+    DCHECK_LT(0U, page_size);
+    page_size_ = page_size;
+  }
+  // @}
+
+  // @name SimulationEventHandler implementation
+  // @{
+  // Starts counting the misses of a new scenario.
+  virtual void OnScenarioStarted(const std::string& name) OVERRIDE;
+
+  // Sets the page size, if it's not set already, and flushes the caches.
+  virtual void OnProcessStarted(base::Time time,
+                                size_t default_page_size) OVERRIDE;
+
+  // Fetches the cache lines and pages of a code block.
+  virtual void OnFunctionEntry(base::Time time, const Block* block) OVERRIDE;
+
+  // The serialization consists of a single dictionary containing the
+  // parameters of the caches, the counts, and the counts of each scenario, if
+  // any.
+  virtual bool SerializeToJSON(FILE* output, bool pretty_print) OVERRIDE;
+  // @}
+
+ private:
+  // Adds the counts of an access to the totals and to the current scenario.
+  void AddAccesses(size_t cache_accesses, size_t cache_misses,
+                   size_t tlb_accesses, size_t tlb_misses);
+
+  // The parameters of the caches.
+  size_t cache_line_size_;
+  size_t cache_size_;
+  size_t cache_associativity_;
+  size_t tlb_entries_;
+  size_t tlb_associativity_;
+  size_t page_size_;
+
+  // The caches, created when the first process starts.
+  scoped_ptr<SetAssociativeCache> cache_;
+  scoped_ptr<SetAssociativeCache> tlb_;
+
+  // The counts of the whole simulation.
+  Counts counts_;
+
+  // The counts of each scenario, in the order they were simulated.
+  ScenarioCountsVector scenarios_;
+
+  DISALLOW_COPY_AND_ASSIGN(CacheSimulation);
+};
+
+}  // namespace simulate
+
+#endif  // SYZYGY_SIMULATE_CACHE_SIMULATION_H_
@@ -0,0 +1,163 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/simulate/cache_simulation.h"
+
+#include "base/file_util.h"
+#include "base/values.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/json/json_reader.h"
+#include "gtest/gtest.h"
+
+namespace simulate {
+
+namespace {
+
+using block_graph::BlockGraph;
+
+class CacheSimulationTest : public testing::Test {
+ public:
+  // Adds a code block to the block graph.
+  // @param start the address of the block.
+  // @param size the size of the block.
+  // @returns the new block.
+  const BlockGraph::Block* AddBlock(uint32 start, size_t size) {
+    BlockGraph::Block* block =
+        block_graph_.AddBlock(BlockGraph::CODE_BLOCK, size, "block");
+    block->set_addr(core::RelativeAddress(start));
+    return block;
+  }
+
+ protected:
+  BlockGraph block_graph_;
+  CacheSimulation simulation_;
+};
+
+}  // namespace
+
+TEST(SetAssociativeCacheTest, EvictsLeastRecentlyUsed) {
+  // Two sets of two entries: even entries map to the first set.
+  SetAssociativeCache cache(4, 2);
+  EXPECT_EQ(2U, cache.num_sets());
+  EXPECT_EQ(2U, cache.associativity());
+
+  EXPECT_FALSE(cache.Access(0));
+  EXPECT_FALSE(cache.Access(2));
+  EXPECT_TRUE(cache.Access(0));
+
+  // This evicts 2, which is the least recently used entry of the first set.
+  EXPECT_FALSE(cache.Access(4));
+  EXPECT_TRUE(cache.Access(0));
+  EXPECT_TRUE(cache.Access(4));
+  EXPECT_FALSE(cache.Access(2));
+
+  // The second set is independent.
+  EXPECT_FALSE(cache.Access(1));
+  EXPECT_TRUE(cache.Access(1));
+
+  cache.Flush();
+  EXPECT_FALSE(cache.Access(1));
+  EXPECT_FALSE(cache.Access(2));
+}
+
+TEST_F(CacheSimulationTest, DefaultParameters) {
+  simulation_.OnProcessStarted(base::Time::Now(), 0);
+
+  EXPECT_EQ(CacheSimulation::kDefaultCacheLineSize,
+            simulation_.cache_line_size());
+  EXPECT_EQ(CacheSimulation::kDefaultCacheSize, simulation_.cache_size());
+  EXPECT_EQ(CacheSimulation::kDefaultCacheAssociativity,
+            simulation_.cache_associativity());
+  EXPECT_EQ(CacheSimulation::kDefaultTlbEntries, simulation_.tlb_entries());
+  EXPECT_EQ(CacheSimulation::kDefaultTlbAssociativity,
+            simulation_.tlb_associativity());
+  EXPECT_EQ(CacheSimulation::kDefaultPageSize, simulation_.page_size());
+}
+
+TEST_F(CacheSimulationTest, CountsMisses) {
+  // A direct-mapped cache of 4 lines of 0x10 bytes, and a TLB of 2 pages of
+  // 0x40 bytes.
+  simulation_.set_cache_line_size(0x10);
+  simulation_.set_cache_size(0x40);
+  simulation_.set_cache_associativity(1);
+  simulation_.set_tlb_entries(2);
+  simulation_.set_tlb_associativity(2);
+  simulation_.set_page_size(0x40);
+
+  simulation_.OnScenarioStarted("scenario");
+  simulation_.OnProcessStarted(base::Time::Now(), 0x1000);
+  EXPECT_EQ(0x40U, simulation_.page_size());
+
+  // Lines 0 to 1 and page 0.
+  base::Time time = base::Time::Now();
+  simulation_.OnFunctionEntry(time, AddBlock(0x0, 0x20));
+  // Lines 3 to 4, over pages 0 and 1. Line 4 evicts line 0.
+  simulation_.OnFunctionEntry(time, AddBlock(0x38, 0x10));
+  // Line 0 again, which was evicted, and page 0, which wasn't.
+  simulation_.OnFunctionEntry(time, AddBlock(0x8, 0x4));
+  // Line 1 again, which hits.
+  simulation_.OnFunctionEntry(time, AddBlock(0x10, 0x10));
+
+  const CacheSimulation::Counts& counts = simulation_.counts();
+  EXPECT_EQ(6U, counts.cache_accesses);
+  EXPECT_EQ(5U, counts.cache_misses);
+  EXPECT_EQ(5U, counts.tlb_accesses);
+  EXPECT_EQ(2U, counts.tlb_misses);
+
+  ASSERT_EQ(1U, simulation_.scenarios().size());
+  EXPECT_EQ("scenario", simulation_.scenarios()[0].name);
+  EXPECT_EQ(5U, simulation_.scenarios()[0].counts.cache_misses);
+
+  // A new process starts with cold caches.
+  simulation_.OnProcessStarted(base::Time::Now(), 0x1000);
+  simulation_.OnFunctionEntry(time, AddBlock(0x10, 0x10));
+  EXPECT_EQ(6U, simulation_.counts().cache_misses);
+  EXPECT_EQ(3U, simulation_.counts().tlb_misses);
+}
+
+TEST_F(CacheSimulationTest, SerializeToJSON) {
+  simulation_.OnScenarioStarted("scenario");
+  simulation_.OnProcessStarted(base::Time::Now(), 0);
+  simulation_.OnFunctionEntry(base::Time::Now(), AddBlock(0x1000, 0x80));
+
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath path = temp_dir.path().AppendASCII("output.json");
+  {
+    file_util::ScopedFILE output(file_util::OpenFile(path, "w"));
+    ASSERT_TRUE(output.get() != NULL);
+    ASSERT_TRUE(simulation_.SerializeToJSON(output.get(), true));
+  }
+
+  std::string contents;
+  ASSERT_TRUE(file_util::ReadFileToString(path, &contents));
+  scoped_ptr<Value> value(base::JSONReader::Read(contents));
+  ASSERT_TRUE(value.get() != NULL);
+  ASSERT_TRUE(value->IsType(Value::TYPE_DICTIONARY));
+
+  const DictionaryValue* dictionary = NULL;
+  ASSERT_TRUE(value->GetAsDictionary(&dictionary));
+  int cache_misses = 0;
+  int tlb_misses = 0;
+  EXPECT_TRUE(dictionary->GetInteger("cache_misses", &cache_misses));
+  EXPECT_TRUE(dictionary->GetInteger("tlb_misses", &tlb_misses));
+  EXPECT_EQ(2, cache_misses);
+  EXPECT_EQ(1, tlb_misses);
+
+  const ListValue* scenarios = NULL;
+  ASSERT_TRUE(dictionary->GetList("scenarios", &scenarios));
+  EXPECT_EQ(1U, scenarios->GetSize());
+}
+
+}  // namespace simulate
@@ -0,0 +1,144 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/simulate/heat_map_histogram.h"
+
+#include "base/logging.h"
+
+namespace simulate {
+
+namespace {
+
+// The number of cells in a tile.
+const size_t kTileSize = HeatMapHistogram::kTileTimeSlices *
+                         HeatMapHistogram::kTileMemorySlices;
+
+}  // namespace
+
+HeatMapHistogram::HeatMapHistogram() : last_tile_(NULL) {
+}
+
+void HeatMapHistogram::Add(TimeSliceId time_slice,
+                           MemorySliceId memory_slice,
+                           uint32 quantity) {
+  DCHECK_LE(0, time_slice);
+
+  TileId tile_id(time_slice / kTileTimeSlices,
+                 memory_slice / kTileMemorySlices);
+  Tile* tile = GetTile(tile_id);
+  DCHECK(tile != NULL);
+
+  size_t row = time_slice % kTileTimeSlices;
+  size_t column = memory_slice % kTileMemorySlices;
+  (*tile)[row * kTileMemorySlices + column] += quantity;
+}
+
+uint32 HeatMapHistogram::Get(TimeSliceId time_slice,
+                             MemorySliceId memory_slice) const {
+  DCHECK_LE(0, time_slice);
+
+  TileId tile_id(time_slice / kTileTimeSlices,
+                 memory_slice / kTileMemorySlices);
+  TileMap::const_iterator tile_it = tiles_.find(tile_id);
+  if (tile_it == tiles_.end())
+    return 0;
+
+  size_t row = time_slice % kTileTimeSlices;
+  size_t column = memory_slice % kTileMemorySlices;
+  return tile_it->second[row * kTileMemorySlices + column];
+}
+
+bool HeatMapHistogram::VisitTimeSlices(
+    const TimeSliceCallback& callback) const {
+  Cells cells;
+  TileMap::const_iterator row_begin = tiles_.begin();
+  while (row_begin != tiles_.end()) {
+    // Find the tiles that share this row of time slices.
+    TileMap::const_iterator row_end = row_begin;
+    while (row_end != tiles_.end() &&
+           row_end->first.first == row_begin->first.first) {
+      ++row_end;
+    }
+
+    // Gather each time slice of the row across its tiles, which are in
+    // increasing memory slice order.
+    for (size_t row = 0; row < kTileTimeSlices; ++row) {
+      cells.clear();
+      TileMap::const_iterator tile_it = row_begin;
+      for (; tile_it != row_end; ++tile_it) {
+        const uint32* counts = &tile_it->second[row * kTileMemorySlices];
+        MemorySliceId first_slice =
+            tile_it->first.second * kTileMemorySlices;
+        for (size_t column = 0; column < kTileMemorySlices; ++column) {
+          if (counts[column] != 0)
+            cells.push_back(Cell(first_slice + column, counts[column]));
+        }
+      }
+
+      if (cells.empty())
+        continue;
+
+      TimeSliceId time_slice = row_begin->first.first * kTileTimeSlices + row;
+      if (!callback.Run(time_slice, cells))
+        return false;
+    }
+
+    row_begin = row_end;
+  }
+
+  return true;
+}
+
+void HeatMapHistogram::Downsample(uint32 time_factor,
+                                  uint32 memory_factor,
+                                  HeatMapHistogram* downsampled) const {
+  DCHECK_LT(0u, time_factor);
+  DCHECK_LT(0u, memory_factor);
+  DCHECK(downsampled != NULL);
+  DCHECK(downsampled->empty());
+
+  TileMap::const_iterator tile_it = tiles_.begin();
+  for (; tile_it != tiles_.end(); ++tile_it) {
+    TimeSliceId first_time_slice = tile_it->first.first * kTileTimeSlices;
+    MemorySliceId first_memory_slice =
+        tile_it->first.second * kTileMemorySlices;
+    const Tile& tile = tile_it->second;
+    for (size_t i = 0; i < kTileSize; ++i) {
+      if (tile[i] == 0)
+        continue;
+      TimeSliceId time_slice = first_time_slice + i / kTileMemorySlices;
+      MemorySliceId memory_slice = first_memory_slice + i % kTileMemorySlices;
+      downsampled->Add(time_slice / time_factor,
+                       memory_slice / memory_factor,
+                       tile[i]);
+    }
+  }
+}
+
+HeatMapHistogram::Tile* HeatMapHistogram::GetTile(const TileId& tile_id) {
+  if (last_tile_ != NULL && last_tile_id_ == tile_id)
+    return last_tile_;
+
+  TileMap::iterator tile_it = tiles_.find(tile_id);
+  if (tile_it == tiles_.end()) {
+    tile_it = tiles_.insert(std::make_pair(tile_id, Tile())).first;
+    tile_it->second.resize(kTileSize, 0);
+  }
+
+  last_tile_id_ = tile_id;
+  last_tile_ = &tile_it->second;
+  return last_tile_;
+}
+
+}  // namespace simulate
@@ -0,0 +1,123 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file declares the HeatMapHistogram class.
+
+#ifndef SYZYGY_SIMULATE_HEAT_MAP_HISTOGRAM_H_
+#define SYZYGY_SIMULATE_HEAT_MAP_HISTOGRAM_H_
+
+#include <time.h>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/callback.h"
+
+namespace simulate {
+
+// A two-dimensional histogram holding a quantity for each pair of time and
+// memory slices. The histogram is divided in fixed-size tiles of adjacent
+// time and memory slices. A tile is stored as a dense array of counts, and is
+// only allocated once one of its cells is used. This keeps the memory use
+// proportional to the touched area of the heat map, rather than to the
+// number of distinct cells, when the slices are small.
+//
+// HeatMapHistogram histogram;
+// histogram.Add(3, 0x10, 42);
+// histogram.Add(3, 0x11, 7);
+// DCHECK_EQ(42u, histogram.Get(3, 0x10));
+//
+// HeatMapHistogram downsampled;
+// histogram.Downsample(2, 4, &downsampled);
+// DCHECK_EQ(49u, downsampled.Get(1, 0x4));
+class HeatMapHistogram {
+ public:
+  typedef time_t TimeSliceId;
+  typedef uint32 MemorySliceId;
+
+  // A memory slice of a time slice, and its quantity.
+  typedef std::pair<MemorySliceId, uint32> Cell;
+  typedef std::vector<Cell> Cells;
+
+  // The callback invoked for each non-empty time slice by VisitTimeSlices.
+  // It receives the time slice and its non-empty cells, in increasing memory
+  // slice order, and returns false to interrupt the visit.
+  typedef base::Callback<bool(TimeSliceId, const Cells&)> TimeSliceCallback;
+
+  // The number of time and memory slices, respectively, covered by a tile.
+  static const size_t kTileTimeSlices = 16;
+  static const size_t kTileMemorySlices = 64;
+
+  HeatMapHistogram();
+
+  // Adds a quantity to a cell of the histogram.
+  // @param time_slice the time slice of the cell.
+  // @param memory_slice the memory slice of the cell.
+  // @param quantity the quantity to add.
+  void Add(TimeSliceId time_slice, MemorySliceId memory_slice, uint32 quantity);
+
+  // @param time_slice the time slice of the cell.
+  // @param memory_slice the memory slice of the cell.
+  // @returns the quantity held by a cell of the histogram.
+  uint32 Get(TimeSliceId time_slice, MemorySliceId memory_slice) const;
+
+  // Visits the non-empty time slices of the histogram in increasing order.
+  // Only the cells of a single time slice are gathered at any given time, so
+  // the histogram may be streamed out.
+  // @param callback the callback to invoke for each time slice.
+  // @returns true on success, false if the callback interrupted the visit.
+  bool VisitTimeSlices(const TimeSliceCallback& callback) const;
+
+  // Produces a coarser histogram, in which each cell sums up @p time_factor
+  // adjacent time slices by @p memory_factor adjacent memory slices.
+  // @param time_factor the number of time slices merged into one.
+  // @param memory_factor the number of memory slices merged into one.
+  // @param downsampled the histogram receiving the result. It must be empty.
+  void Downsample(uint32 time_factor,
+                  uint32 memory_factor,
+                  HeatMapHistogram* downsampled) const;
+
+  // @returns true if no quantity has been added to the histogram.
+  bool empty() const { return tiles_.empty(); }
+
+  // @returns the number of tiles allocated by the histogram.
+  size_t tile_count() const { return tiles_.size(); }
+
+ protected:
+  // Identifies a tile by its row of time slices and its column of memory
+  // slices. Ordering tiles this way groups them by time.
+  typedef std::pair<TimeSliceId, MemorySliceId> TileId;
+  typedef std::vector<uint32> Tile;
+  typedef std::map<TileId, Tile> TileMap;
+
+  // @returns the tile holding a cell, allocating it as needed.
+  Tile* GetTile(const TileId& tile_id);
+
+  // The allocated tiles. Each one holds kTileTimeSlices rows of
+  // kTileMemorySlices counts.
+  TileMap tiles_;
+
+  // The most recently used tile. Consecutive additions tend to hit the same
+  // tile, which saves a lookup.
+  TileId last_tile_id_;
+  Tile* last_tile_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(HeatMapHistogram);
+};
+
+}  // namespace simulate
+
+#endif  // SYZYGY_SIMULATE_HEAT_MAP_HISTOGRAM_H_
@@ -0,0 +1,126 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/simulate/heat_map_histogram.h"
+
+#include "base/bind.h"
+#include "gtest/gtest.h"
+
+namespace simulate {
+
+namespace {
+
+typedef HeatMapHistogram::Cells Cells;
+typedef HeatMapHistogram::TimeSliceId TimeSliceId;
+typedef std::vector<std::pair<TimeSliceId, Cells> > TimeSliceVector;
+
+// Appends a visited time slice to @p time_slices.
+bool AppendTimeSlice(TimeSliceVector* time_slices,
+                     TimeSliceId time_slice,
+                     const Cells& cells) {
+  time_slices->push_back(std::make_pair(time_slice, cells));
+  return true;
+}
+
+// Interrupts a visit.
+bool FailVisit(TimeSliceId time_slice, const Cells& cells) {
+  return false;
+}
+
+}  // namespace
+
+TEST(HeatMapHistogramTest, AddAndGet) {
+  HeatMapHistogram histogram;
+  EXPECT_TRUE(histogram.empty());
+  EXPECT_EQ(0u, histogram.Get(0, 0));
+
+  histogram.Add(0, 0, 3);
+  histogram.Add(0, 0, 4);
+  histogram.Add(17, 1000, 5);
+  EXPECT_FALSE(histogram.empty());
+
+  EXPECT_EQ(7u, histogram.Get(0, 0));
+  EXPECT_EQ(5u, histogram.Get(17, 1000));
+  EXPECT_EQ(0u, histogram.Get(17, 1001));
+  EXPECT_EQ(0u, histogram.Get(16, 1000));
+  EXPECT_EQ(0u, histogram.Get(1000, 17));
+}
+
+TEST(HeatMapHistogramTest, TilesAreAllocatedOnUse) {
+  HeatMapHistogram histogram;
+
+  // Cells of the same tile share its storage.
+  for (size_t i = 0; i < HeatMapHistogram::kTileTimeSlices; ++i) {
+    for (size_t j = 0; j < HeatMapHistogram::kTileMemorySlices; ++j)
+      histogram.Add(i, j, 1);
+  }
+  EXPECT_EQ(1u, histogram.tile_count());
+
+  // Far apart cells each get their own tile, and those in between don't.
+  histogram.Add(0, 1000000, 1);
+  histogram.Add(1000000, 0, 1);
+  EXPECT_EQ(3u, histogram.tile_count());
+}
+
+TEST(HeatMapHistogramTest, VisitTimeSlices) {
+  HeatMapHistogram histogram;
+  histogram.Add(20, 3, 1);
+  histogram.Add(1, 500, 2);
+  histogram.Add(1, 7, 3);
+  histogram.Add(20, 70, 4);
+  histogram.Add(1, 64, 5);
+
+  TimeSliceVector time_slices;
+  EXPECT_TRUE(histogram.VisitTimeSlices(
+      base::Bind(&AppendTimeSlice, base::Unretained(&time_slices))));
+
+  // The time slices, and their cells, are visited in increasing order.
+  ASSERT_EQ(2u, time_slices.size());
+  EXPECT_EQ(1, time_slices[0].first);
+  ASSERT_EQ(3u, time_slices[0].second.size());
+  EXPECT_EQ(HeatMapHistogram::Cell(7, 3), time_slices[0].second[0]);
+  EXPECT_EQ(HeatMapHistogram::Cell(64, 5), time_slices[0].second[1]);
+  EXPECT_EQ(HeatMapHistogram::Cell(500, 2), time_slices[0].second[2]);
+  EXPECT_EQ(20, time_slices[1].first);
+  ASSERT_EQ(2u, time_slices[1].second.size());
+  EXPECT_EQ(HeatMapHistogram::Cell(3, 1), time_slices[1].second[0]);
+  EXPECT_EQ(HeatMapHistogram::Cell(70, 4), time_slices[1].second[1]);
+
+  EXPECT_FALSE(histogram.VisitTimeSlices(base::Bind(&FailVisit)));
+}
+
+TEST(HeatMapHistogramTest, Downsample) {
+  HeatMapHistogram histogram;
+  histogram.Add(0, 0, 1);
+  histogram.Add(1, 3, 2);
+  histogram.Add(2, 4, 3);
+  histogram.Add(35, 130, 4);
+
+  HeatMapHistogram downsampled;
+  histogram.Downsample(2, 4, &downsampled);
+  EXPECT_EQ(3u, downsampled.Get(0, 0));
+  EXPECT_EQ(3u, downsampled.Get(1, 1));
+  EXPECT_EQ(4u, downsampled.Get(17, 32));
+  EXPECT_EQ(0u, downsampled.Get(1, 0));
+
+  // Downsampling by one leaves the histogram unchanged.
+  HeatMapHistogram copy;
+  histogram.Downsample(1, 1, &copy);
+  EXPECT_EQ(1u, copy.Get(0, 0));
+  EXPECT_EQ(2u, copy.Get(1, 3));
+  EXPECT_EQ(3u, copy.Get(2, 4));
+  EXPECT_EQ(4u, copy.Get(35, 130));
+}
+
+}  // namespace simulate
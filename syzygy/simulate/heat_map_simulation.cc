@@ -14,13 +14,29 @@
 
 #include "syzygy/simulate/heat_map_simulation.h"
 
+#include "base/bind.h"
+
 namespace simulate {
 
+namespace {
+
+// @returns the number of adjacent slices to merge so that @p num_slices
+//     slices fit in @p max_slices, or 1 if there is no maximum.
+uint32 GetDownsampleFactor(uint64 num_slices, uint32 max_slices) {
+  if (max_slices == 0 || num_slices <= max_slices)
+    return 1;
+  return static_cast<uint32>((num_slices + max_slices - 1) / max_slices);
+}
+
+}  // namespace
+
 HeatMapSimulation::HeatMapSimulation()
     : time_slice_usecs_(kDefaultTimeSliceSize),
       memory_slice_bytes_(kDefaultMemorySliceSize),
       max_time_slice_usecs_(0),
       max_memory_slice_bytes_(0),
+      max_output_time_slices_(0),
+      max_output_memory_slices_(0),
       output_individual_functions_(false) {
 }
 
@@ -60,26 +76,46 @@ bool HeatMapSimulation::TimeSlice::PrintJSONFunctions(
   return true;
 }
 
-bool HeatMapSimulation::SerializeToJSON(FILE* output, bool pretty_print) {
-  typedef TimeSlice::FunctionMap FunctionMap;
-
-  DCHECK(output != NULL);
+bool HeatMapSimulation::PrintJSONTimeSlice(
+    core::JSONFileWriter* json_file,
+    TimeSliceId time_slice_id,
+    const HeatMapHistogram::Cells& cells) {
+  DCHECK(json_file != NULL);
+
+  uint32 total = 0;
+  for (size_t i = 0; i < cells.size(); ++i)
+    total += cells[i].second;
+
+  if (!json_file->OpenDict() ||
+      !json_file->OutputKey("timestamp") ||
+      !json_file->OutputInteger(time_slice_id) ||
+      !json_file->OutputKey("total_memory_slices") ||
+      !json_file->OutputInteger(total) ||
+      !json_file->OutputKey("memory_slice_list") ||
+      !json_file->OpenList()) {
+    return false;
+  }
 
-  core::JSONFileWriter json_file(output, pretty_print);
+  for (size_t i = 0; i < cells.size(); ++i) {
+    if (!json_file->OpenDict() ||
+        !json_file->OutputKey("memory_slice") ||
+        !json_file->OutputInteger(cells[i].first) ||
+        !json_file->OutputKey("quantity") ||
+        !json_file->OutputInteger(cells[i].second) ||
+        !json_file->CloseDict())
+      return false;
+  }
 
-  if (!json_file.OpenDict() ||
-      !json_file.OutputKey("time_slice_usecs") ||
-      !json_file.OutputInteger(time_slice_usecs_) ||
-      !json_file.OutputKey("memory_slice_bytes") ||
-      !json_file.OutputInteger(memory_slice_bytes_) ||
-      !json_file.OutputKey("max_time_slice_usecs") ||
-      !json_file.OutputInteger(max_time_slice_usecs_) ||
-      !json_file.OutputKey("max_memory_slice_bytes") ||
-      !json_file.OutputInteger(max_memory_slice_bytes_) ||
-      !json_file.OutputKey("time_slice_list") ||
-      !json_file.OpenList()) {
+  if (!json_file->CloseList() ||
+      !json_file->CloseDict())
     return false;
-  }
+
+  return true;
+}
+
+bool HeatMapSimulation::PrintJSONTimeMemoryMap(
+    core::JSONFileWriter* json_file) const {
+  DCHECK(json_file != NULL);
 
   TimeMemoryMap::const_iterator time_memory_iter = time_memory_map_.begin();
   for (; time_memory_iter != time_memory_map_.end(); ++time_memory_iter) {
@@ -87,13 +123,13 @@ bool HeatMapSimulation::SerializeToJSON(FILE* output, bool pretty_print) {
     uint32 total = time_memory_iter->second.total();
     const TimeSlice& time_slice = time_memory_iter->second;
 
-    if (!json_file.OpenDict() ||
-        !json_file.OutputKey("timestamp") ||
-        !json_file.OutputInteger(time) ||
-        !json_file.OutputKey("total_memory_slices") ||
-        !json_file.OutputInteger(total) ||
-        !json_file.OutputKey("memory_slice_list") ||
-        !json_file.OpenList()) {
+    if (!json_file->OpenDict() ||
+        !json_file->OutputKey("timestamp") ||
+        !json_file->OutputInteger(time) ||
+        !json_file->OutputKey("total_memory_slices") ||
+        !json_file->OutputInteger(total) ||
+        !json_file->OutputKey("memory_slice_list") ||
+        !json_file->OpenList()) {
       return false;
     }
 
@@ -101,26 +137,74 @@ bool HeatMapSimulation::SerializeToJSON(FILE* output, bool pretty_print) {
         time_slice.slices().begin();
 
     for (; slices_iter != time_slice.slices().end(); ++slices_iter) {
-      if (!json_file.OpenDict() ||
-          !json_file.OutputKey("memory_slice") ||
-          !json_file.OutputInteger(slices_iter->first) ||
-          !json_file.OutputKey("quantity") ||
-          !json_file.OutputInteger(slices_iter->second.total))
+      if (!json_file->OpenDict() ||
+          !json_file->OutputKey("memory_slice") ||
+          !json_file->OutputInteger(slices_iter->first) ||
+          !json_file->OutputKey("quantity") ||
+          !json_file->OutputInteger(slices_iter->second.total) ||
+          !TimeSlice::PrintJSONFunctions(*json_file,
+                                         slices_iter->second.functions) ||
+          !json_file->CloseDict())
         return false;
+    }
+
+    if (!json_file->CloseList() ||
+        !json_file->CloseDict())
+      return false;
+  }
 
-      if (output_individual_functions_) {
-        if (!TimeSlice::PrintJSONFunctions(json_file,
-                                           slices_iter->second.functions))
-          return false;
-      }
+  return true;
+}
 
-      if (!json_file.CloseDict())
-        return false;
-    }
+bool HeatMapSimulation::SerializeToJSON(FILE* output, bool pretty_print) {
+  DCHECK(output != NULL);
 
-    if (!json_file.CloseList() ||
-        !json_file.CloseDict())
+  // Merge adjacent slices as needed to fit the maximum output sizes. The
+  // individual functions are never merged.
+  uint32 time_factor = 1;
+  uint32 memory_factor = 1;
+  if (!output_individual_functions_) {
+    time_factor = GetDownsampleFactor(
+        static_cast<uint64>(max_time_slice_usecs_) + 1,
+        max_output_time_slices_);
+    memory_factor = GetDownsampleFactor(
+        static_cast<uint64>(max_memory_slice_bytes_) + 1,
+        max_output_memory_slices_);
+  }
+
+  const HeatMapHistogram* histogram = &histogram_;
+  HeatMapHistogram downsampled;
+  if (time_factor != 1 || memory_factor != 1) {
+    histogram_.Downsample(time_factor, memory_factor, &downsampled);
+    histogram = &downsampled;
+  }
+
+  core::JSONFileWriter json_file(output, pretty_print);
+
+  if (!json_file.OpenDict() ||
+      !json_file.OutputKey("time_slice_usecs") ||
+      !json_file.OutputInteger(time_slice_usecs_ * time_factor) ||
+      !json_file.OutputKey("memory_slice_bytes") ||
+      !json_file.OutputInteger(memory_slice_bytes_ * memory_factor) ||
+      !json_file.OutputKey("max_time_slice_usecs") ||
+      !json_file.OutputInteger(max_time_slice_usecs_ / time_factor) ||
+      !json_file.OutputKey("max_memory_slice_bytes") ||
+      !json_file.OutputInteger(max_memory_slice_bytes_ / memory_factor) ||
+      !json_file.OutputKey("time_slice_list") ||
+      !json_file.OpenList()) {
+    return false;
+  }
+
+  if (output_individual_functions_) {
+    if (!PrintJSONTimeMemoryMap(&json_file))
+      return false;
+  } else {
+    // The time slices are streamed out of the histogram, one at a time.
+    if (!histogram->VisitTimeSlices(
+            base::Bind(&HeatMapSimulation::PrintJSONTimeSlice,
+                       base::Unretained(&json_file)))) {
       return false;
+    }
   }
 
   if (!json_file.CloseList() ||
@@ -142,12 +226,13 @@ void HeatMapSimulation::OnFunctionEntry(base::Time time,
   time_t relative_time = (time - process_start_time_).InMicroseconds();
 
   // Since we will insert to a map many TimeSlices with the same entry time,
-  // we can pass RegisterFunction a reference to the TimeSlice in the map.
-  // This way, RegisterFunction doesn't have to search for that position
-  // every time it gets called and the time complexity gets reduced
-  // in a logarithmic scale.
+  // we can pass AddSlice a pointer to the TimeSlice in the map. This way,
+  // AddSlice doesn't have to search for that position every time it gets
+  // called and the time complexity gets reduced in a logarithmic scale.
   TimeSliceId time_slice = relative_time / time_slice_usecs_;
-  TimeSlice& slice = time_memory_map_[time_slice];
+  TimeSlice* slice = NULL;
+  if (output_individual_functions_)
+    slice = &time_memory_map_[time_slice];
 
   max_time_slice_usecs_ = std::max(max_time_slice_usecs_, time_slice);
 
@@ -161,7 +246,7 @@ void HeatMapSimulation::OnFunctionEntry(base::Time time,
   const uint32 last_slice = (block_start + size - 1) / memory_slice_bytes_;
   if (first_slice == last_slice) {
     // This function fits in a single memory slice. Add it to our time slice.
-    slice.AddSlice(first_slice, name, size);
+    AddSlice(time_slice, slice, first_slice, name, size);
   } else {
     // This function takes several memory slices. Add the first and last
     // slices to our time slice only with the part of the slice they use,
@@ -173,17 +258,27 @@ void HeatMapSimulation::OnFunctionEntry(base::Time time,
         ((block_start + size - 1 + memory_slice_bytes_) %
             memory_slice_bytes_) + 1;
 
-    slice.AddSlice(first_slice, name, leading_bytes);
-    slice.AddSlice(last_slice, name, trailing_bytes);
+    AddSlice(time_slice, slice, first_slice, name, leading_bytes);
+    AddSlice(time_slice, slice, last_slice, name, trailing_bytes);
 
     const uint32 kStartIndex = block_start / memory_slice_bytes_ + 1;
     const uint32 kEndIndex = (block_start + size - 1) / memory_slice_bytes_;
 
     for (uint32 i = kStartIndex; i < kEndIndex; i++)
-      slice.AddSlice(i, name, memory_slice_bytes_);
+      AddSlice(time_slice, slice, i, name, memory_slice_bytes_);
   }
 
   max_memory_slice_bytes_ = std::max(max_memory_slice_bytes_, last_slice);
 }
 
+void HeatMapSimulation::AddSlice(TimeSliceId time_slice_id,
+                                 TimeSlice* time_slice,
+                                 MemorySliceId memory_slice,
+                                 const base::StringPiece& name,
+                                 uint32 num_bytes) {
+  histogram_.Add(time_slice_id, memory_slice, num_bytes);
+  if (time_slice != NULL)
+    time_slice->AddSlice(memory_slice, name, num_bytes);
+}
+
 }  // namespace simulate
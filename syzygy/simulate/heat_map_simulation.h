@@ -22,6 +22,7 @@
 
 #include "base/string_piece.h"
 #include "syzygy/core/json_file_writer.h"
+#include "syzygy/simulate/heat_map_histogram.h"
 #include "syzygy/simulate/simulation_event_handler.h"
 #include "syzygy/trace/parse/parser.h"
 
@@ -44,6 +45,12 @@ namespace simulate {
 //
 // If the time slice size or the memory slice size are not set, the default
 // values of 1 and 0x8000, respectively, are used.
+//
+// The quantities are accumulated in a HeatMapHistogram, which stays compact
+// for fine-grained slices. The names of the functions in each slice are only
+// kept when output_individual_functions is set, as they make for a much
+// bigger footprint. Otherwise the heat map may be downsampled on output to a
+// maximum number of time and memory slices.
 class HeatMapSimulation : public SimulationEventHandler {
  public:
   class TimeSlice;
@@ -63,12 +70,17 @@ class HeatMapSimulation : public SimulationEventHandler {
   // @name Accessors.
   // @{
   const TimeMemoryMap& time_memory_map() const { return time_memory_map_; }
+  const HeatMapHistogram& histogram() const { return histogram_; }
   uint32 time_slice_usecs() const { return time_slice_usecs_; }
   uint32 memory_slice_bytes() const { return memory_slice_bytes_; }
   TimeSliceId max_time_slice_usecs() const { return max_time_slice_usecs_; }
   MemorySliceId max_memory_slice_bytes() const {
     return max_memory_slice_bytes_;
   }
+  uint32 max_output_time_slices() const { return max_output_time_slices_; }
+  uint32 max_output_memory_slices() const {
+    return max_output_memory_slices_;
+  }
   // @}
 
   // @name Mutators.
@@ -85,8 +97,25 @@ class HeatMapSimulation : public SimulationEventHandler {
     DCHECK_LT(0u, memory_slice_bytes);
     memory_slice_bytes_ = memory_slice_bytes;
   }
+  // Set the maximum number of time slices output by SerializeToJSON. Adjacent
+  // time slices are merged as needed to fit. This does not apply when
+  // outputting individual functions.
+  // @param max_output_time_slices The maximum number of time slices, or zero
+  //     for no maximum.
+  void set_max_output_time_slices(uint32 max_output_time_slices) {
+    max_output_time_slices_ = max_output_time_slices;
+  }
+  // Set the maximum number of memory slices output by SerializeToJSON.
+  // Adjacent memory slices are merged as needed to fit. This does not apply
+  // when outputting individual functions.
+  // @param max_output_memory_slices The maximum number of memory slices, or
+  //     zero for no maximum.
+  void set_max_output_memory_slices(uint32 max_output_memory_slices) {
+    max_output_memory_slices_ = max_output_memory_slices;
+  }
   // Set whether SerializeToJSON outputs information about each individual
-  // function in each time/memory block.
+  // function in each time/memory block. This must be set before any function
+  // entry is handled.
   // @param print_output_individual_functions true for saving the names of each
   //     function, false otherwise.
   void set_output_individual_functions(bool output_individual_functions) {
@@ -113,8 +142,11 @@ class HeatMapSimulation : public SimulationEventHandler {
   // time slice, and of another list with dictionaries containing each
   // separate memory slice, the number of times it was used, and a list
   // of all the used functions and the number of times they were used in that
-  // memory slice in descending order. If output_individual_functions is true,
-  // then the list of function for each memory slice isn't printed. Example:
+  // memory slice in descending order. If output_individual_functions is false,
+  // then the list of function for each memory slice isn't printed, and the
+  // time and memory slices may be merged to fit the maximum output sizes, in
+  // which case the slice sizes and maximums reported are those of the merged
+  // slices. Example:
   // {
   //   "time_slice_usecs": 1,
   //   "memory_slice_bytes": 32768,
@@ -178,17 +210,52 @@ class HeatMapSimulation : public SimulationEventHandler {
   // @}
 
  protected:
+  // Adds a quantity of bytes to a pair of time and memory slices.
+  // @param time_slice_id The time slice.
+  // @param time_slice The time slice entry in time_memory_map_, or NULL if
+  //     individual functions aren't output.
+  // @param memory_slice The memory slice.
+  // @param name The name of the function which uses the memory slice.
+  // @param num_bytes The value to be added, in bytes.
+  void AddSlice(TimeSliceId time_slice_id,
+                TimeSlice* time_slice,
+                MemorySliceId memory_slice,
+                const base::StringPiece& name,
+                uint32 num_bytes);
+
+  // Serializes a time slice of histogram_, without individual functions.
+  // @param json_file The file where the time slice will be serialized.
+  // @param time_slice_id The time slice.
+  // @param cells The memory slices of the time slice.
+  // @returns true on success, false on failure.
+  static bool PrintJSONTimeSlice(core::JSONFileWriter* json_file,
+                                 TimeSliceId time_slice_id,
+                                 const HeatMapHistogram::Cells& cells);
+
+  // Serializes the time slices of time_memory_map_, along with their
+  // individual functions.
+  // @param json_file The file where the time slices will be serialized.
+  // @returns true on success, false on failure.
+  bool PrintJSONTimeMemoryMap(core::JSONFileWriter* json_file) const;
+
   // The size of each time block on the heat map, in microseconds.
   uint32 time_slice_usecs_;
 
   // The size of each memory block on the heat map, in bytes.
   uint32 memory_slice_bytes_;
 
-  // A map which contains the density of each pair of time and memory slices.
-  // TODO(fixman): If there aren't many possible relative times,
-  // this will probably be better off as a vector.
+  // A map which contains the functions in each pair of time and memory
+  // slices. This is only populated when output_individual_functions_ is set.
   TimeMemoryMap time_memory_map_;
 
+  // The density of each pair of time and memory slices.
+  HeatMapHistogram histogram_;
+
+  // The maximum number of time and memory slices output, respectively, or
+  // zero for no maximum.
+  uint32 max_output_time_slices_;
+  uint32 max_output_memory_slices_;
+
   // The time when the process was started. Used to convert absolute function
   // entry times to relative times since start of process.
   base::Time process_start_time_;
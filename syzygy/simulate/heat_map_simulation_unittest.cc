@@ -17,6 +17,9 @@
 #include <map>
 #include <vector>
 
+#include "base/file_util.h"
+#include "base/values.h"
+#include "base/json/json_reader.h"
 #include "syzygy/common/syzygy_version.h"
 #include "syzygy/core/random_number_generator.h"
 #include "syzygy/core/unittest_util.h"
@@ -452,21 +455,124 @@ TEST_F(HeatMapSimulationTest, RandomInput) {
                                    random_input[i].block);
     }
 
+    // The individual functions aren't kept, only the quantities.
+    EXPECT_TRUE(simulation_->time_memory_map().empty());
+
     for (uint32 i = 0; i < expected_size; i++) {
-      HeatMapSimulation::TimeMemoryMap::const_iterator current_slice =
-        simulation_->time_memory_map().find(expected_times[i]);
+      TimeSlice::MemorySliceMap::const_iterator slice_iter =
+          expected_slices[i].begin();
+      for (; slice_iter != expected_slices[i].end(); ++slice_iter) {
+        EXPECT_EQ(slice_iter->second.total,
+                  simulation_->histogram().Get(expected_times[i],
+                                               slice_iter->first));
+      }
+    }
 
-      ASSERT_NE(current_slice, simulation_->time_memory_map().end());
-      ASSERT_TRUE(current_slice->second.slices().size() ==
-          expected_slices[i].size());
+    ASSERT_FALSE(testing::Test::HasNonfatalFailure()) << s.str();
+  }
+}
 
-      EXPECT_TRUE(std::equal(current_slice->second.slices().begin(),
-                             current_slice->second.slices().end(),
-                             expected_slices[i].begin(),
-                             CompareMemorySlices<false>()));
+TEST_F(HeatMapSimulationTest, HistogramMatchesTimeMemoryMap) {
+  simulation_->set_output_individual_functions(true);
+  simulation_->set_memory_slice_bytes(1);
+  simulation_->OnProcessStarted(time, 0);
+  for (uint32 i = 0; i < arraysize(blocks_); i++) {
+    simulation_->OnFunctionEntry(Time::FromTimeT(blocks_[i].time),
+                                 blocks_[i].block);
+  }
+
+  HeatMapSimulation::TimeMemoryMap::const_iterator time_iter =
+      simulation_->time_memory_map().begin();
+  for (; time_iter != simulation_->time_memory_map().end(); ++time_iter) {
+    TimeSlice::MemorySliceMap::const_iterator slice_iter =
+        time_iter->second.slices().begin();
+    for (; slice_iter != time_iter->second.slices().end(); ++slice_iter) {
+      EXPECT_EQ(slice_iter->second.total,
+                simulation_->histogram().Get(time_iter->first,
+                                             slice_iter->first));
     }
+  }
+}
 
-    ASSERT_FALSE(testing::Test::HasNonfatalFailure()) << s.str();
+TEST_F(HeatMapSimulationTest, SerializeDownsampled) {
+  simulation_->set_memory_slice_bytes(1);
+  simulation_->set_max_output_time_slices(2);
+  simulation_->set_max_output_memory_slices(7);
+  simulation_->OnProcessStarted(time, 0);
+  for (uint32 i = 0; i < arraysize(blocks_); i++) {
+    simulation_->OnFunctionEntry(Time::FromTimeT(blocks_[i].time),
+                                 blocks_[i].block);
+  }
+
+  base::FilePath temp_dir;
+  CreateTemporaryDir(&temp_dir);
+  base::FilePath path;
+  file_util::ScopedFILE temp_file;
+  temp_file.reset(file_util::CreateAndOpenTemporaryFileInDir(temp_dir, &path));
+  ASSERT_TRUE(temp_file.get() != NULL);
+  ASSERT_TRUE(simulation_->SerializeToJSON(temp_file.get(), false));
+  temp_file.reset();
+
+  std::string file_string;
+  ASSERT_TRUE(file_util::ReadFileToString(path, &file_string));
+  scoped_ptr<base::Value> value(base::JSONReader::Read(file_string));
+  ASSERT_TRUE(value.get() != NULL);
+  const base::DictionaryValue* outer_dict = NULL;
+  ASSERT_TRUE(value->GetAsDictionary(&outer_dict));
+
+  // The 30000001 time slices are merged by 15000001, so that they fit in 2,
+  // and the 14 memory slices are merged by 2, so that they fit in 7.
+  int time_slice_usecs = 0;
+  int memory_slice_bytes = 0;
+  int max_time_slice_usecs = 0;
+  int max_memory_slice_bytes = 0;
+  EXPECT_TRUE(outer_dict->GetInteger("time_slice_usecs", &time_slice_usecs));
+  EXPECT_TRUE(outer_dict->GetInteger("memory_slice_bytes",
+                                     &memory_slice_bytes));
+  EXPECT_TRUE(outer_dict->GetInteger("max_time_slice_usecs",
+                                     &max_time_slice_usecs));
+  EXPECT_TRUE(outer_dict->GetInteger("max_memory_slice_bytes",
+                                     &max_memory_slice_bytes));
+  EXPECT_EQ(15000001, time_slice_usecs);
+  EXPECT_EQ(2, memory_slice_bytes);
+  EXPECT_EQ(1, max_time_slice_usecs);
+  EXPECT_EQ(6, max_memory_slice_bytes);
+
+  static const int kExpectedTotals[] = { 22, 5 };
+  static const int kExpectedSlices[][2] = {
+      { 0, 4 }, { 1, 5 }, { 2, 2 }, { 5, 7 }, { 6, 4 },
+      { 1, 2 }, { 2, 2 }, { 3, 1 } };
+  static const size_t kExpectedSliceCounts[] = { 5, 3 };
+
+  const base::ListValue* time_slice_list = NULL;
+  ASSERT_TRUE(outer_dict->GetList("time_slice_list", &time_slice_list));
+  ASSERT_EQ(arraysize(kExpectedTotals), time_slice_list->GetSize());
+  size_t expected_slice = 0;
+  for (size_t i = 0; i < time_slice_list->GetSize(); ++i) {
+    const base::DictionaryValue* time_slice = NULL;
+    ASSERT_TRUE(time_slice_list->GetDictionary(i, &time_slice));
+    int timestamp = 0;
+    int total = 0;
+    EXPECT_TRUE(time_slice->GetInteger("timestamp", &timestamp));
+    EXPECT_TRUE(time_slice->GetInteger("total_memory_slices", &total));
+    EXPECT_EQ(static_cast<int>(i), timestamp);
+    EXPECT_EQ(kExpectedTotals[i], total);
+
+    const base::ListValue* memory_slice_list = NULL;
+    ASSERT_TRUE(time_slice->GetList("memory_slice_list", &memory_slice_list));
+    ASSERT_EQ(kExpectedSliceCounts[i], memory_slice_list->GetSize());
+    for (size_t j = 0; j < memory_slice_list->GetSize(); ++j) {
+      const base::DictionaryValue* memory_slice = NULL;
+      ASSERT_TRUE(memory_slice_list->GetDictionary(j, &memory_slice));
+      int id = 0;
+      int quantity = 0;
+      EXPECT_TRUE(memory_slice->GetInteger("memory_slice", &id));
+      EXPECT_TRUE(memory_slice->GetInteger("quantity", &quantity));
+      EXPECT_EQ(kExpectedSlices[expected_slice][0], id);
+      EXPECT_EQ(kExpectedSlices[expected_slice][1], quantity);
+      EXPECT_FALSE(memory_slice->HasKey("functions"));
+      ++expected_slice;
+    }
   }
 }
 
@@ -0,0 +1,348 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Evaluates an order file by simulating the trace files of an RPC
+// instrumented dll on the layout the order would produce, without relinking
+// the image. This reports the page-faults, the working set early on, and the
+// misses of the instruction cache and TLB, so that order generators can be
+// compared quickly.
+
+#include <objbase.h>
+#include <iostream>
+
+#include "base/at_exit.h"
+#include "base/command_line.h"
+#include "base/string_number_conversions.h"
+#include "base/string_split.h"
+#include "syzygy/core/json_file_writer.h"
+#include "syzygy/playback/scenario.h"
+#include "syzygy/reorder/reorderer.h"
+#include "syzygy/simulate/cache_simulation.h"
+#include "syzygy/simulate/order_layout.h"
+#include "syzygy/simulate/page_fault_simulation.h"
+#include "syzygy/simulate/simulation_set.h"
+#include "syzygy/simulate/simulator.h"
+#include "syzygy/simulate/working_set_simulation.h"
+#include "syzygy/wsdump/working_set_timeline.h"
+
+namespace {
+
+using simulate::CacheSimulation;
+using simulate::OrderLayout;
+using simulate::PageFaultSimulation;
+using simulate::SimulationSet;
+using simulate::Simulator;
+using simulate::WorkingSetSimulation;
+using wsdump::WorkingSetTimeline;
+
+const char kUsage[] =
+    "Usage: order_benchmark [options] [RPC log files ...]\n"
+    "  Required Options:\n"
+    "    --instrumented-dll=<path> the path to the instrumented DLL.\n"
+    "  Optional Options:\n"
+    "    --order-file=<path> the order to evaluate. The original layout of\n"
+    "        the image is evaluated if this isn't specified.\n"
+    "    --input-dll=<path> the input DLL from where the trace files belong.\n"
+    "    --scenarios=<path> the path to a JSON file grouping the trace files\n"
+    "        in scenarios; don't specify RPC log files.\n"
+    "    --output-file=<path> the output file.\n"
+    "    --pretty-print enables pretty printing of the JSON output file.\n"
+    "    --working-set-ms=INTS the times since the start of each process at\n"
+    "        which to measure its working set, in milliseconds, as a\n"
+    "        comma-separated list (default 100,1000).\n"
+    "    --measured-working-set=<path> a working set timeline captured by\n"
+    "        wsdump --timeline-file. The working set it measured at each of\n"
+    "        the working-set-ms times is reported next to the simulated one.\n"
+    "    --measured-module=<name> the module whose pages are counted in the\n"
+    "        measured working set (default: the file name of input-dll, or\n"
+    "        of instrumented-dll if input-dll isn't specified).\n"
+    "    --page-size=INT the size of each page, in bytes (default 4KB).\n"
+    "    --pages-per-code-fault=INT The number of pages loaded by each\n"
+    "        page-fault (default 8)\n";
+
+const char kDefaultWorkingSetMs[] = "100,1000";
+
+int Usage(const char* message) {
+  std::cerr << message << std::endl << kUsage;
+  return 1;
+}
+
+// Parses an optional positive integer.
+// @param cmd_line the command line to parse.
+// @param switch_name the name of the switch holding the integer.
+// @param value receives the integer, or 0 if the switch isn't present.
+// @returns true on success, false if the integer is invalid.
+bool ParseInt(const CommandLine* cmd_line,
+              const char* switch_name,
+              int* value) {
+  DCHECK(cmd_line != NULL);
+  DCHECK(value != NULL);
+
+  *value = 0;
+  std::string str = cmd_line->GetSwitchValueASCII(switch_name);
+  if (str.empty())
+    return true;
+  return base::StringToInt(str, value) && *value > 0;
+}
+
+// Reads a working set timeline from a file.
+bool ReadTimeline(const base::FilePath& path, WorkingSetTimeline* timeline) {
+  DCHECK(timeline != NULL);
+
+  file_util::ScopedFILE file(file_util::OpenFile(path, "rb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open " << path.value() << ".";
+    return false;
+  }
+  core::FileInStream in_stream(file.get());
+  return timeline->Read(&in_stream);
+}
+
+// Writes the results of the simulations.
+// @param measured the working set timeline measured on the real image, or
+//     NULL if there isn't one.
+// @param measured_module the module of interest in @p measured.
+bool WriteResults(const base::FilePath& order_path,
+                  const PageFaultSimulation& page_faults,
+                  const WorkingSetSimulation& working_sets,
+                  const CacheSimulation& caches,
+                  const WorkingSetTimeline* measured,
+                  const std::wstring& measured_module,
+                  core::JSONFileWriter* json_file) {
+  DCHECK(json_file != NULL);
+
+  if (!json_file->OpenDict() ||
+      !json_file->OutputKey("order_file") ||
+      !json_file->OutputString(order_path.value()) ||
+      !json_file->OutputKey("page_size") ||
+      !json_file->OutputInteger(page_faults.page_size()) ||
+      !json_file->OutputKey("page_faults") ||
+      !json_file->OutputInteger(page_faults.fault_count()) ||
+      !json_file->OutputKey("process_count") ||
+      !json_file->OutputInteger(working_sets.process_count()) ||
+      !json_file->OutputKey("working_sets") ||
+      !json_file->OpenList()) {
+    return false;
+  }
+
+  const WorkingSetSimulation::WorkingSetVector& sets =
+      working_sets.working_sets();
+  for (size_t i = 0; i < sets.size(); ++i) {
+    double average_pages = 0.0;
+    if (working_sets.process_count() != 0) {
+      average_pages = static_cast<double>(sets[i].total_pages) /
+          working_sets.process_count();
+    }
+    if (!json_file->OpenDict() ||
+        !json_file->OutputKey("time_limit_ms") ||
+        !json_file->OutputInteger(
+            static_cast<int>(sets[i].time_limit.InMilliseconds())) ||
+        !json_file->OutputKey("average_pages") ||
+        !json_file->OutputDouble(average_pages)) {
+      return false;
+    }
+    if (measured != NULL) {
+      uint32 time_ms = static_cast<uint32>(
+          sets[i].time_limit.InMilliseconds());
+      size_t measured_pages =
+          measured->CountModulePages(measured_module, time_ms);
+      if (!json_file->OutputKey("measured_pages") ||
+          !json_file->OutputInteger(measured_pages)) {
+        return false;
+      }
+    }
+    if (!json_file->CloseDict())
+      return false;
+  }
+
+  const CacheSimulation::Counts& counts = caches.counts();
+  if (!json_file->CloseList() ||
+      !json_file->OutputKey("cache_accesses") ||
+      !json_file->OutputInteger(counts.cache_accesses) ||
+      !json_file->OutputKey("cache_misses") ||
+      !json_file->OutputInteger(counts.cache_misses) ||
+      !json_file->OutputKey("tlb_accesses") ||
+      !json_file->OutputInteger(counts.tlb_accesses) ||
+      !json_file->OutputKey("tlb_misses") ||
+      !json_file->OutputInteger(counts.tlb_misses) ||
+      !json_file->CloseDict()) {
+    return false;
+  }
+
+  DCHECK(json_file->Finished());
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  base::AtExitManager at_exit_manager;
+  CommandLine::Init(argc, argv);
+
+  if (!logging::InitLogging(L"", logging::LOG_ONLY_TO_SYSTEM_DEBUG_LOG,
+      logging::DONT_LOCK_LOG_FILE, logging::APPEND_TO_OLD_LOG_FILE,
+      logging::ENABLE_DCHECK_FOR_NON_OFFICIAL_RELEASE_BUILDS)) {
+    return 1;
+  }
+
+  CommandLine* cmd_line = CommandLine::ForCurrentProcess();
+  DCHECK(cmd_line != NULL);
+
+  // Parse the command line.
+  base::FilePath instrumented_dll_path =
+      cmd_line->GetSwitchValuePath("instrumented-dll");
+  base::FilePath input_dll_path = cmd_line->GetSwitchValuePath("input-dll");
+  base::FilePath order_path = cmd_line->GetSwitchValuePath("order-file");
+  base::FilePath output_file_path = cmd_line->GetSwitchValuePath("output-file");
+  bool pretty_print = cmd_line->HasSwitch("pretty-print");
+  base::FilePath measured_path =
+      cmd_line->GetSwitchValuePath("measured-working-set");
+  std::wstring measured_module =
+      cmd_line->GetSwitchValueNative("measured-module");
+  if (measured_module.empty()) {
+    measured_module = input_dll_path.empty() ?
+        instrumented_dll_path.BaseName().value() :
+        input_dll_path.BaseName().value();
+  }
+
+  std::vector<base::FilePath> trace_paths;
+  for (size_t i = 0; i < cmd_line->GetArgs().size(); ++i)
+    trace_paths.push_back(base::FilePath(cmd_line->GetArgs()[i]));
+
+  playback::ScenarioVector scenarios;
+  base::FilePath scenario_path = cmd_line->GetSwitchValuePath("scenarios");
+
+  if (instrumented_dll_path.empty())
+    return Usage("You must specify instrumented-dll.");
+  if (!scenario_path.empty()) {
+    if (!trace_paths.empty())
+      return Usage("Trace files are not accepted along with scenarios.");
+    if (!playback::LoadScenariosFromJSON(scenario_path, &scenarios))
+      return Usage("Invalid scenarios file.");
+  } else if (trace_paths.empty()) {
+    return Usage("You must specify at least one trace file.");
+  }
+
+  int page_size = 0;
+  int pages_per_code_fault = 0;
+  if (!ParseInt(cmd_line, "page-size", &page_size))
+    return Usage("Invalid page-size value.");
+  if (!ParseInt(cmd_line, "pages-per-code-fault", &pages_per_code_fault))
+    return Usage("Invalid pages-per-code-fault value.");
+
+  std::string working_set_ms_str =
+      cmd_line->GetSwitchValueASCII("working-set-ms");
+  if (working_set_ms_str.empty())
+    working_set_ms_str = kDefaultWorkingSetMs;
+  std::vector<std::string> working_set_ms_items;
+  base::SplitString(working_set_ms_str, ',', &working_set_ms_items);
+
+  scoped_ptr<WorkingSetSimulation> working_sets(new WorkingSetSimulation());
+  for (size_t i = 0; i < working_set_ms_items.size(); ++i) {
+    int working_set_ms = 0;
+    if (!base::StringToInt(working_set_ms_items[i], &working_set_ms) ||
+        working_set_ms <= 0) {
+      return Usage("Invalid working-set-ms value.");
+    }
+    working_sets->AddTimeLimit(
+        base::TimeDelta::FromMilliseconds(working_set_ms));
+  }
+
+  scoped_ptr<WorkingSetTimeline> measured;
+  if (!measured_path.empty()) {
+    measured.reset(new WorkingSetTimeline());
+    if (!ReadTimeline(measured_path, measured.get())) {
+      LOG(ERROR) << "Unable to read working set timeline: "
+                 << measured_path.value();
+      return 1;
+    }
+  }
+
+  // The events are recorded once, then replayed on the layout of the order.
+  SimulationSet simulations;
+  Simulator simulator(input_dll_path,
+                      instrumented_dll_path,
+                      trace_paths,
+                      &simulations);
+  simulator.set_scenarios(scenarios);
+
+  LOG(INFO) << "Parsing trace files.";
+  if (!simulator.ParseTraceFiles()) {
+    LOG(ERROR) << "Could not parse trace files.";
+    return 1;
+  }
+
+  OrderLayout layout;
+  if (!order_path.empty()) {
+    LOG(INFO) << "Applying order " << order_path.value() << ".";
+    reorder::Reorderer::Order order;
+    if (!order.LoadFromJSON(simulator.pe_file(), simulator.image_layout(),
+                            order_path)) {
+      LOG(ERROR) << "Unable to load order file: " << order_path.value();
+      return 1;
+    }
+
+    size_t section_alignment =
+        simulator.pe_file().nt_headers()->OptionalHeader.SectionAlignment;
+    if (!layout.Build(simulator.image_layout(), section_alignment, order)) {
+      LOG(ERROR) << "Unable to apply order file: " << order_path.value();
+      return 1;
+    }
+    simulations.ReplaceBlocks(layout.blocks());
+  }
+
+  PageFaultSimulation* page_faults = new PageFaultSimulation();
+  CacheSimulation* caches = new CacheSimulation();
+  if (page_size != 0) {
+    page_faults->set_page_size(page_size);
+    working_sets->set_page_size(page_size);
+    caches->set_page_size(page_size);
+  }
+  if (pages_per_code_fault != 0)
+    page_faults->set_pages_per_code_fault(pages_per_code_fault);
+
+  WorkingSetSimulation* working_sets_ptr = working_sets.release();
+  simulations.AddSimulation(page_faults);
+  simulations.AddSimulation(working_sets_ptr);
+  simulations.AddSimulation(caches);
+
+  LOG(INFO) << "Running simulations.";
+  simulations.Simulate();
+  working_sets_ptr->Finish();
+
+  file_util::ScopedFILE output_file;
+  FILE* output = NULL;
+  if (output_file_path.empty()) {
+    output = stdout;
+  } else {
+    output_file.reset(file_util::OpenFile(output_file_path, "w"));
+    output = output_file.get();
+
+    if (output == NULL) {
+      LOG(ERROR) << "Failed to open " << output_file_path.value()
+          << " for writing.";
+      return 1;
+    }
+  }
+
+  LOG(INFO) << "Writing JSON file.";
+  core::JSONFileWriter json_file(output, pretty_print);
+  if (!WriteResults(order_path, *page_faults, *working_sets_ptr, *caches,
+                    measured.get(), measured_module, &json_file)) {
+    LOG(ERROR) << "Unable to write JSON file.";
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,130 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/simulate/order_layout.h"
+
+#include <set>
+#include <vector>
+
+#include "syzygy/common/align.h"
+
+namespace simulate {
+
+namespace {
+
+using core::RelativeAddress;
+using reorder::Reorderer;
+
+typedef std::vector<const block_graph::BlockGraph::Block*> ConstBlockVector;
+
+}  // namespace
+
+OrderLayout::OrderLayout() {
+}
+
+bool OrderLayout::Build(const pe::ImageLayout& image_layout,
+                        size_t section_alignment,
+                        const Reorderer::Order& order) {
+  DCHECK(common::IsPowerOfTwo(section_alignment));
+  DCHECK(blocks_.empty());
+
+  // Gather the blocks of each section, starting with the ordered ones.
+  const size_t kNumOriginalSections = image_layout.sections.size();
+  std::vector<ConstBlockVector> sections(kNumOriginalSections);
+  std::set<const Block*> ordered_blocks;
+  for (size_t i = 0; i < order.sections.size(); ++i) {
+    const Reorderer::Order::SectionSpec& section_spec = order.sections[i];
+
+    size_t section_index = section_spec.id;
+    if (section_spec.id == Reorderer::Order::SectionSpec::kNewSectionId) {
+      section_index = sections.size();
+      sections.resize(sections.size() + 1);
+    } else if (section_index >= kNumOriginalSections) {
+      LOG(ERROR) << "No section found with ID " << section_spec.id << ".";
+      return false;
+    }
+
+    for (size_t j = 0; j < section_spec.blocks.size(); ++j) {
+      const Block* block = section_spec.blocks[j].block;
+      DCHECK(block != NULL);
+      if (block->section() == BlockGraph::kInvalidSectionId) {
+        LOG(ERROR) << "Block \"" << block->name() << "\" can't be ordered.";
+        return false;
+      }
+      if (!ordered_blocks.insert(block).second) {
+        LOG(ERROR) << "Block \"" << block->name() << "\" is ordered twice.";
+        return false;
+      }
+      sections[section_index].push_back(block);
+    }
+  }
+
+  // Add the remaining blocks in their original order. Those that are outside
+  // of any section stay where they are.
+  BlockGraph::AddressSpace::RangeMapConstIter block_it =
+      image_layout.blocks.begin();
+  for (; block_it != image_layout.blocks.end(); ++block_it) {
+    const Block* block = block_it->second;
+    if (block->section() == BlockGraph::kInvalidSectionId ||
+        block->section() >= kNumOriginalSections) {
+      AddBlock(block, block_it->first.start());
+      continue;
+    }
+
+    if (ordered_blocks.find(block) == ordered_blocks.end())
+      sections[block->section()].push_back(block);
+  }
+
+  // Lay out the sections one after the other.
+  RelativeAddress cursor;
+  if (kNumOriginalSections > 0)
+    cursor = image_layout.sections[0].addr;
+  for (size_t i = 0; i < sections.size(); ++i) {
+    cursor = cursor.AlignUp(section_alignment);
+    if (i < kNumOriginalSections && cursor < image_layout.sections[i].addr)
+      cursor = image_layout.sections[i].addr;
+
+    const ConstBlockVector& blocks = sections[i];
+    for (size_t j = 0; j < blocks.size(); ++j) {
+      cursor = cursor.AlignUp(blocks[j]->alignment());
+      AddBlock(blocks[j], cursor);
+      cursor += blocks[j]->size();
+    }
+  }
+
+  return true;
+}
+
+const OrderLayout::Block* OrderLayout::GetBlock(const Block* block) const {
+  BlockMap::const_iterator it = blocks_.find(block);
+  if (it == blocks_.end())
+    return NULL;
+  return it->second;
+}
+
+void OrderLayout::AddBlock(const Block* block, RelativeAddress addr) {
+  DCHECK(block != NULL);
+
+  Block* copy = block_graph_.AddBlock(block->type(), block->size(),
+                                      block->name());
+  DCHECK(copy != NULL);
+  copy->set_addr(addr);
+  copy->set_section(block->section());
+  copy->set_alignment(block->alignment());
+
+  bool inserted = blocks_.insert(std::make_pair(block, copy)).second;
+  DCHECK(inserted);
+}
+
+}  // namespace simulate
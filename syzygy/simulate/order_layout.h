@@ -0,0 +1,83 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file declares the OrderLayout class, which computes the addresses the
+// blocks of an image would have once an order is applied to it, without
+// relinking the image.
+
+#ifndef SYZYGY_SIMULATE_ORDER_LAYOUT_H_
+#define SYZYGY_SIMULATE_ORDER_LAYOUT_H_
+
+#include <map>
+
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/pe/image_layout.h"
+#include "syzygy/reorder/reorderer.h"
+
+namespace simulate {
+
+// Lays out the blocks of an image according to an order, the way the
+// explicit orderer does: the ordered blocks of a section are placed first,
+// followed by the remaining blocks of the section in their original order.
+// New sections are placed after the existing ones. Each block is represented
+// by a copy, with the same size and type, at its new address. Simulations can
+// then be run on these copies to evaluate an order.
+//
+// Sections keep their original address, unless the sections that precede
+// them have grown, and blocks that don't belong to any section aren't moved.
+// As a result, applying the original order of an image reproduces its
+// original layout.
+class OrderLayout {
+ public:
+  typedef block_graph::BlockGraph BlockGraph;
+  typedef BlockGraph::Block Block;
+  typedef std::map<const Block*, const Block*> BlockMap;
+
+  OrderLayout();
+
+  // Lays out the blocks of an image according to an order. This can only be
+  // called once.
+  // @param image_layout the original layout of the image.
+  // @param section_alignment the alignment of the sections of the image.
+  // @param order the order to apply.
+  // @returns true on success, false if the order is invalid.
+  bool Build(const pe::ImageLayout& image_layout,
+             size_t section_alignment,
+             const reorder::Reorderer::Order& order);
+
+  // @returns the copies of the blocks of the original image, at their new
+  //     address.
+  const BlockMap& blocks() const { return blocks_; }
+
+  // @returns the copy of @p block, or NULL if it isn't part of the image.
+  const Block* GetBlock(const Block* block) const;
+
+ private:
+  // Creates the copy of a block.
+  // @param block the block to copy.
+  // @param addr the address of the copy.
+  void AddBlock(const Block* block, core::RelativeAddress addr);
+
+  // The block graph holding the copies of the blocks.
+  BlockGraph block_graph_;
+
+  // The copies of the blocks of the original image.
+  BlockMap blocks_;
+
+  DISALLOW_COPY_AND_ASSIGN(OrderLayout);
+};
+
+}  // namespace simulate
+
+#endif  // SYZYGY_SIMULATE_ORDER_LAYOUT_H_
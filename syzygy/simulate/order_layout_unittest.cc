@@ -0,0 +1,140 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/simulate/order_layout.h"
+
+#include "gtest/gtest.h"
+
+namespace simulate {
+
+namespace {
+
+using block_graph::BlockGraph;
+using core::RelativeAddress;
+using reorder::Reorderer;
+
+class OrderLayoutTest : public testing::Test {
+ public:
+  OrderLayoutTest() : image_layout_(&block_graph_) {
+  }
+
+  virtual void SetUp() OVERRIDE {
+    // A header block, and two sections of three blocks each.
+    header_ = AddBlock(RelativeAddress(0x0), 0x400, kInvalidSection);
+    AddSection(".text", RelativeAddress(0x1000), 0x1000);
+    AddSection(".data", RelativeAddress(0x2000), 0x1000);
+    for (size_t i = 0; i < 3; ++i) {
+      text_[i] = AddBlock(RelativeAddress(0x1000 + i * 0x100), 0x100, 0);
+      data_[i] = AddBlock(RelativeAddress(0x2000 + i * 0x100), 0x100, 1);
+    }
+  }
+
+  void AddSection(const char* name, RelativeAddress addr, size_t size) {
+    block_graph_.AddSection(name, 0);
+    pe::ImageLayout::SectionInfo info = {};
+    info.name = name;
+    info.addr = addr;
+    info.size = size;
+    info.data_size = size;
+    image_layout_.sections.push_back(info);
+  }
+
+  BlockGraph::Block* AddBlock(RelativeAddress addr,
+                              size_t size,
+                              BlockGraph::SectionId section) {
+    BlockGraph::Block* block =
+        block_graph_.AddBlock(BlockGraph::CODE_BLOCK, size, "block");
+    block->set_section(section);
+    EXPECT_TRUE(image_layout_.blocks.InsertBlock(addr, block));
+    return block;
+  }
+
+  // @returns the address of the copy of @p block in @p layout.
+  RelativeAddress GetAddress(const OrderLayout& layout,
+                             const BlockGraph::Block* block) {
+    const BlockGraph::Block* copy = layout.GetBlock(block);
+    EXPECT_TRUE(copy != NULL);
+    if (copy == NULL)
+      return RelativeAddress();
+    EXPECT_EQ(block->size(), copy->size());
+    return copy->addr();
+  }
+
+  static const BlockGraph::SectionId kInvalidSection;
+
+  BlockGraph block_graph_;
+  pe::ImageLayout image_layout_;
+  BlockGraph::Block* header_;
+  BlockGraph::Block* text_[3];
+  BlockGraph::Block* data_[3];
+};
+
+const BlockGraph::SectionId OrderLayoutTest::kInvalidSection =
+    BlockGraph::kInvalidSectionId;
+
+}  // namespace
+
+TEST_F(OrderLayoutTest, EmptyOrderKeepsLayout) {
+  Reorderer::Order order;
+  OrderLayout layout;
+  ASSERT_TRUE(layout.Build(image_layout_, 0x1000, order));
+
+  EXPECT_EQ(7U, layout.blocks().size());
+  EXPECT_EQ(RelativeAddress(0x0), GetAddress(layout, header_));
+  for (size_t i = 0; i < 3; ++i) {
+    EXPECT_EQ(text_[i]->addr(), GetAddress(layout, text_[i]));
+    EXPECT_EQ(data_[i]->addr(), GetAddress(layout, data_[i]));
+  }
+}
+
+TEST_F(OrderLayoutTest, AppliesOrder) {
+  // Move the last block of .text first, and a .data block to a new section.
+  Reorderer::Order order;
+  order.sections.resize(2);
+  order.sections[0].id = 0;
+  order.sections[0].blocks.push_back(Reorderer::Order::BlockSpec(text_[2]));
+  order.sections[1].name = ".new";
+  order.sections[1].blocks.push_back(Reorderer::Order::BlockSpec(data_[0]));
+
+  // Align the second .text block, which now starts at 0x1100.
+  text_[1]->set_alignment(0x200);
+
+  OrderLayout layout;
+  ASSERT_TRUE(layout.Build(image_layout_, 0x1000, order));
+
+  EXPECT_EQ(RelativeAddress(0x1000), GetAddress(layout, text_[2]));
+  EXPECT_EQ(RelativeAddress(0x1100), GetAddress(layout, text_[0]));
+  EXPECT_EQ(RelativeAddress(0x1200), GetAddress(layout, text_[1]));
+  EXPECT_EQ(RelativeAddress(0x2000), GetAddress(layout, data_[1]));
+  EXPECT_EQ(RelativeAddress(0x2100), GetAddress(layout, data_[2]));
+  EXPECT_EQ(RelativeAddress(0x3000), GetAddress(layout, data_[0]));
+}
+
+TEST_F(OrderLayoutTest, FailsOnInvalidOrder) {
+  Reorderer::Order order;
+  order.sections.resize(1);
+  order.sections[0].id = 0;
+  order.sections[0].blocks.push_back(Reorderer::Order::BlockSpec(text_[0]));
+  order.sections[0].blocks.push_back(Reorderer::Order::BlockSpec(text_[0]));
+
+  OrderLayout layout1;
+  EXPECT_FALSE(layout1.Build(image_layout_, 0x1000, order));
+
+  order.sections[0].blocks.pop_back();
+  order.sections[0].id = 5;
+  OrderLayout layout2;
+  EXPECT_FALSE(layout2.Build(image_layout_, 0x1000, order));
+}
+
+}  // namespace simulate
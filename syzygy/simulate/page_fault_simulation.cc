@@ -24,6 +24,11 @@ PageFaultSimulation::PageFaultSimulation()
       pages_per_code_fault_(kDefaultPagesPerCodeFault) {
 }
 
+void PageFaultSimulation::OnScenarioStarted(const std::string& name) {
+  scenarios_.push_back(ScenarioFaults());
+  scenarios_.back().name = name;
+}
+
 void PageFaultSimulation::OnProcessStarted(base::Time /*time*/,
                                            size_t default_page_size) {
   // Set the page size if it wasn't set by the user yet.
@@ -50,8 +55,28 @@ bool PageFaultSimulation::SerializeToJSON(FILE* output,
       !json_file.OutputKey("pages_per_code_fault") ||
       !json_file.OutputInteger(pages_per_code_fault_) ||
       !json_file.OutputKey("fault_count") ||
-      !json_file.OutputInteger(fault_count_) ||
-      !json_file.OutputKey("loaded_pages") ||
+      !json_file.OutputInteger(fault_count_)) {
+    return false;
+  }
+
+  if (!scenarios_.empty()) {
+    if (!json_file.OutputKey("scenarios") || !json_file.OpenList())
+      return false;
+    for (size_t i = 0; i < scenarios_.size(); ++i) {
+      if (!json_file.OpenDict() ||
+          !json_file.OutputKey("name") ||
+          !json_file.OutputString(scenarios_[i].name) ||
+          !json_file.OutputKey("fault_count") ||
+          !json_file.OutputInteger(scenarios_[i].fault_count) ||
+          !json_file.CloseDict()) {
+        return false;
+      }
+    }
+    if (!json_file.CloseList())
+      return false;
+  }
+
+  if (!json_file.OutputKey("loaded_pages") ||
       !json_file.OpenList()) {
     return false;
   }
@@ -79,20 +104,36 @@ void PageFaultSimulation::OnFunctionEntry(base::Time /*time*/,
 
   const uint32 block_start = block->addr().value();
   const uint32 block_size = block->size();
+  fault_count_ += FaultBlock(block_start, block_size, &pages_);
+  if (!scenarios_.empty()) {
+    ScenarioFaults& scenario = scenarios_.back();
+    scenario.fault_count +=
+        FaultBlock(block_start, block_size, &scenario.pages);
+  }
+}
+
+size_t PageFaultSimulation::FaultBlock(uint32 block_start,
+                                       uint32 block_size,
+                                       PageSet* pages) {
+  DCHECK(pages != NULL);
+
   const size_t kStartIndex = block_start / page_size_;
   const size_t kEndIndex = (block_start + block_size +
       page_size_ - 1) / page_size_;
 
   // Loop through all the pages in the block, and if it isn't already in memory
   // then simulate a code fault and load all the faulting pages in memory.
+  size_t fault_count = 0;
   for (size_t i = kStartIndex; i < kEndIndex; i++) {
-    if (pages_.find(i) == pages_.end()) {
-      fault_count_++;
+    if (pages->find(i) == pages->end()) {
+      fault_count++;
       for (size_t j = 0; j < pages_per_code_fault_; j++) {
-        pages_.insert(i + j);
+        pages->insert(i + j);
       }
     }
   }
+
+  return fault_count;
 }
 
 }  // namespace simulate
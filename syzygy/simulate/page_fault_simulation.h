@@ -17,6 +17,9 @@
 #ifndef SYZYGY_SIMULATE_PAGE_FAULT_SIMULATION_H_
 #define SYZYGY_SIMULATE_PAGE_FAULT_SIMULATION_H_
 
+#include <string>
+#include <vector>
+
 #include "syzygy/simulate/simulation_event_handler.h"
 #include "syzygy/trace/parse/parser.h"
 
@@ -40,11 +43,24 @@ namespace simulate {
 //
 // If the page size is not set, then it's deduced from the trace file data
 // or, if that's not possible, it's set to the default value of 0x1000 (4 KB).
+//
+// When the trace files are grouped in scenarios, the page-faults of each
+// scenario are also counted as if it had been simulated on its own.
 class PageFaultSimulation : public SimulationEventHandler {
  public:
   typedef block_graph::BlockGraph::Block Block;
   typedef std::set<uint32> PageSet;
 
+  // The page-faults of a scenario.
+  struct ScenarioFaults {
+    ScenarioFaults() : fault_count(0) {}
+
+    std::string name;
+    PageSet pages;
+    size_t fault_count;
+  };
+  typedef std::vector<ScenarioFaults> ScenarioFaultsVector;
+
   // The default page size, in case neither the user nor the system
   // provide one.
   static const size_t kDefaultPageSize = 0x1000;
@@ -59,6 +75,7 @@ class PageFaultSimulation : public SimulationEventHandler {
   // @{
   const PageSet& pages() const { return pages_; }
   size_t fault_count() const { return fault_count_; }
+  const ScenarioFaultsVector& scenarios() const { return scenarios_; }
   size_t page_size() const { return page_size_; }
   size_t pages_per_code_fault() const { return pages_per_code_fault_; }
   // @}
@@ -77,6 +94,9 @@ class PageFaultSimulation : public SimulationEventHandler {
 
   // @name SimulationEventHandler implementation
   // @{
+  // Starts counting the page-faults of a new scenario.
+  void OnScenarioStarted(const std::string& name) OVERRIDE;
+
   // Sets the initial page size, if it's not set already.
   void OnProcessStarted(base::Time time, size_t default_page_size) OVERRIDE;
 
@@ -84,11 +104,19 @@ class PageFaultSimulation : public SimulationEventHandler {
   void OnFunctionEntry(base::Time time, const Block* block) OVERRIDE;
 
   // The serialization consists of a single dictionary containing
-  // the block number of each block that pagefaulted.
+  // the block number of each block that pagefaulted, and the fault count
+  // of each scenario, if any.
   bool SerializeToJSON(FILE* output, bool pretty_print) OVERRIDE;
   // @}
 
  protected:
+  // Simulates the page-faults caused by touching a block.
+  // @param block_start The address of the block.
+  // @param block_size The size of the block.
+  // @param pages The pages currently in memory, which are updated.
+  // @returns the number of page-faults.
+  size_t FaultBlock(uint32 block_start, uint32 block_size, PageSet* pages);
+
   // A set which contains the block number of the pages that
   // were faulted in the trace files.
   PageSet pages_;
@@ -96,6 +124,9 @@ class PageFaultSimulation : public SimulationEventHandler {
   // The total number of page-faults detected.
   size_t fault_count_;
 
+  // The page-faults of each scenario, in the order they were simulated.
+  ScenarioFaultsVector scenarios_;
+
   // The size of each page, in bytes. If not set, PageFaultSimulator will
   // try to load the system value, or uses kDefaultPageSize
   // if it's unavailable.
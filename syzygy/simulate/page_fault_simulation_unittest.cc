@@ -327,6 +327,33 @@ TEST_F(PageFaultSimulatorTest, ExactPageFaults) {
       arraysize(expected_pages)));
 }
 
+TEST_F(PageFaultSimulatorTest, ScenarioPageFaults) {
+  simulation_->OnProcessStarted(time_, 1);
+  simulation_->set_page_size(1);
+  simulation_->set_pages_per_code_fault(4);
+
+  MockBlockInfo blocks[] = {
+      MockBlockInfo(0, 3, &block_graph_),
+      MockBlockInfo(2, 2, &block_graph_),
+      MockBlockInfo(5, 5, &block_graph_)
+  };
+
+  simulation_->OnScenarioStarted("startup");
+  simulation_->OnFunctionEntry(time_, blocks[0].block);
+  simulation_->OnScenarioStarted("idle");
+  simulation_->OnFunctionEntry(time_, blocks[1].block);
+  simulation_->OnFunctionEntry(time_, blocks[2].block);
+
+  // The total doesn't depend on the scenarios, but each scenario starts out
+  // with no pages in memory.
+  EXPECT_EQ(3U, simulation_->fault_count());
+  ASSERT_EQ(2U, simulation_->scenarios().size());
+  EXPECT_EQ("startup", simulation_->scenarios()[0].name);
+  EXPECT_EQ(1U, simulation_->scenarios()[0].fault_count);
+  EXPECT_EQ("idle", simulation_->scenarios()[1].name);
+  EXPECT_EQ(3U, simulation_->scenarios()[1].fault_count);
+}
+
 TEST_F(PageFaultSimulatorTest, CorrectPageFaults) {
   simulation_->OnProcessStarted(time_, 1);
 
@@ -21,13 +21,23 @@
       'target_name': 'simulate_lib',
       'type': 'static_library',
       'sources': [
+        'cache_simulation.cc',
+        'cache_simulation.h',
+        'heat_map_histogram.cc',
+        'heat_map_histogram.h',
         'heat_map_simulation.cc',
         'heat_map_simulation.h',
+        'order_layout.cc',
+        'order_layout.h',
         'page_fault_simulation.cc',
         'page_fault_simulation.h',
         'simulation_event_handler.h',
+        'simulation_set.cc',
+        'simulation_set.h',
         'simulator.cc',
         'simulator.h',
+        'working_set_simulation.cc',
+        'working_set_simulation.h',
       ],
       'dependencies': [
         '<(src)/sawbuck/log_lib/log_lib.gyp:log_lib',
@@ -35,6 +45,7 @@
         '<(src)/syzygy/pdb/pdb.gyp:pdb_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
         '<(src)/syzygy/playback/playback.gyp:playback_lib',
+        '<(src)/syzygy/reorder/reorder.gyp:reorder_lib',
         '<(src)/syzygy/trace/parse/parse.gyp:parse_lib',
       ],
     },
@@ -49,14 +60,31 @@
         '<(src)/base/base.gyp:base',
       ],
     },
+    {
+      'target_name': 'order_benchmark',
+      'type': 'executable',
+      'sources': [
+        'order_benchmark_main.cc',
+      ],
+      'dependencies': [
+        'simulate_lib',
+        '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/wsdump/wsdump.gyp:wsdump_lib',
+      ],
+    },
     {
       'target_name': 'simulate_unittests',
       'type': 'executable',
       'sources': [
+        'cache_simulation_unittest.cc',
+        'heat_map_histogram_unittest.cc',
         'heat_map_simulation_unittest.cc',
+        'order_layout_unittest.cc',
         'page_fault_simulation_unittest.cc',
         'simulate_unittests_main.cc',
+        'simulation_set_unittest.cc',
         'simulator_unittest.cc',
+        'working_set_simulation_unittest.cc',
       ],
       'dependencies': [
         'simulate_lib',
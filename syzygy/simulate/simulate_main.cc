@@ -21,45 +21,129 @@
 
 #include "base/at_exit.h"
 #include "base/command_line.h"
+#include "base/memory/scoped_vector.h"
 #include "base/string_number_conversions.h"
+#include "base/string_split.h"
+#include "syzygy/playback/scenario.h"
+#include "syzygy/simulate/cache_simulation.h"
 #include "syzygy/simulate/heat_map_simulation.h"
 #include "syzygy/simulate/page_fault_simulation.h"
+#include "syzygy/simulate/simulation_set.h"
 #include "syzygy/simulate/simulator.h"
 
 namespace {
 
+using simulate::CacheSimulation;
 using simulate::HeatMapSimulation;
 using simulate::PageFaultSimulation;
 using simulate::SimulationEventHandler;
+using simulate::SimulationSet;
 using simulate::Simulator;
 
 const char kUsage[] =
     "Usage: simulate [options] [RPC log files ...]\n"
     "  Required Options:\n"
     "    --instrumented-dll=<path> the path to the instrumented DLL.\n"
-    "    --simulate-method=pagefault|heatmap what method used to simulate\n"
-    "        the trace files.\n"
+    "    --simulate-method=pagefault|heatmap|cache what method used to\n"
+    "        simulate the trace files.\n"
     "  Optional Options:\n"
     "    --pretty-print enables pretty printing of the JSON output file.\n"
     "    --input-dll=<path> the input DLL from where the trace files belong.\n"
     "    --output-file=<path> the output file.\n"
+    "    --scenarios=<path> the path to a JSON file grouping the trace files\n"
+    "        in scenarios, which are simulated in turn; don't specify RPC log\n"
+    "        files. The page fault method also reports each scenario.\n"
     "    For page fault method:\n"
-    "      --pages-per-code-fault=INT The number of pages loaded by each\n"
+    "      --pages-per-code-fault=INTS The number of pages loaded by each\n"
     "          page-fault (default 8)\n"
-    "      --page-size=INT the size of each page, in bytes (default 4KB).\n"
+    "      --page-size=INTS the size of each page, in bytes (default 4KB).\n"
     "    For heat map method:\n"
-    "      --time-slice-usecs=INT the size of each time slice in the heatmap,\n"
-    "          in microseconds (default 1).\n"
-    "      --memory-slice-bytes=INT the size of each memory slice,\n"
+    "      --time-slice-usecs=INTS the size of each time slice in the\n"
+    "          heatmap, in microseconds (default 1).\n"
+    "      --memory-slice-bytes=INTS the size of each memory slice,\n"
     "          in bytes (default 32KB).\n"
     "      --output-individual-functions Output information about each\n"
-    "          function in each time/memory block\n";
+    "          function in each time/memory block\n"
+    "      --max-time-slices=INT the maximum number of time slices output;\n"
+    "          adjacent time slices are merged to fit. Doesn't apply along\n"
+    "          with --output-individual-functions.\n"
+    "      --max-memory-slices=INT the maximum number of memory slices\n"
+    "          output; adjacent memory slices are merged to fit. Doesn't\n"
+    "          apply along with --output-individual-functions.\n"
+    "    For cache method, which counts the misses of the instruction cache\n"
+    "    and TLB:\n"
+    "      --cache-size=INTS the size of the cache, in bytes (default 32KB).\n"
+    "      --cache-associativity=INTS the number of lines per cache set\n"
+    "          (default 8).\n"
+    "      --cache-line-size=INT the size of a cache line, in bytes\n"
+    "          (default 64).\n"
+    "      --tlb-entries=INT the number of TLB entries (default 64).\n"
+    "      --tlb-associativity=INT the number of entries per TLB set\n"
+    "          (default 4).\n"
+    "      --page-size=INT the size of each page, in bytes (default 4KB).\n"
+    "  The INTS options accept comma-separated lists of values, in which\n"
+    "  case every combination of values is simulated, in parallel, from a\n"
+    "  single parse of the trace files. The output is then a list holding the\n"
+    "  result of each combination.\n"
+    "    --num-threads=INT the number of threads used to run the simulations\n"
+    "        (defaults to the number of processors).\n";
 
 int Usage(const char* message) {
   std::cerr << message << std::endl << kUsage;
   return 1;
 }
 
+// Parses a comma-separated list of positive integers.
+// @param cmd_line the command line to parse.
+// @param switch_name the name of the switch holding the list.
+// @param values receives the values of the list. This is left untouched if the
+//     switch isn't present, so that it keeps holding the default values.
+// @returns true on success, false if the list is invalid.
+bool ParseIntList(const CommandLine* cmd_line,
+                  const char* switch_name,
+                  std::vector<int>* values) {
+  DCHECK(cmd_line != NULL);
+  DCHECK(switch_name != NULL);
+  DCHECK(values != NULL);
+
+  std::string str = cmd_line->GetSwitchValueASCII(switch_name);
+  if (str.empty())
+    return true;
+
+  std::vector<std::string> items;
+  base::SplitString(str, ',', &items);
+
+  std::vector<int> parsed_values;
+  for (size_t i = 0; i < items.size(); ++i) {
+    int value = 0;
+    if (!base::StringToInt(items[i], &value) || value <= 0)
+      return false;
+    parsed_values.push_back(value);
+  }
+
+  values->swap(parsed_values);
+  return true;
+}
+
+// Parses a positive integer.
+// @param cmd_line the command line to parse.
+// @param switch_name the name of the switch holding the integer.
+// @param value receives the integer. This is left untouched if the switch
+//     isn't present, so that it keeps holding the default value.
+// @returns true on success, false if the integer is invalid.
+bool ParseInt(const CommandLine* cmd_line,
+              const char* switch_name,
+              int* value) {
+  DCHECK(value != NULL);
+
+  std::vector<int> values(1, *value);
+  if (!ParseIntList(cmd_line, switch_name, &values) || values.size() != 1)
+    return false;
+
+  *value = values[0];
+  return true;
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -76,7 +160,6 @@ int main(int argc, char** argv) {
   DCHECK(cmd_line != NULL);
 
   // Parse the command line.
-  typedef CommandLine::StringType StringType;
   base::FilePath instrumented_dll_path =
       cmd_line->GetSwitchValuePath("instrumented-dll");
   base::FilePath input_dll_path = cmd_line->GetSwitchValuePath("input-dll");
@@ -89,74 +172,152 @@ int main(int argc, char** argv) {
   for (size_t i = 0; i < cmd_line->GetArgs().size(); ++i)
     trace_paths.push_back(base::FilePath(cmd_line->GetArgs()[i]));
 
+  playback::ScenarioVector scenarios;
+  base::FilePath scenario_path = cmd_line->GetSwitchValuePath("scenarios");
+
   if (instrumented_dll_path.empty())
     return Usage("You must specify instrumented-dll.");
-  if (trace_paths.empty())
+  if (!scenario_path.empty()) {
+    if (!trace_paths.empty())
+      return Usage("Trace files are not accepted along with scenarios.");
+    if (!playback::LoadScenariosFromJSON(scenario_path, &scenarios))
+      return Usage("Invalid scenarios file.");
+  } else if (trace_paths.empty()) {
     return Usage("You must specify at least one trace file.");
+  }
 
-  scoped_ptr<SimulationEventHandler> simulation;
+  // The configurations to simulate. A value of zero leaves the default of
+  // the simulation untouched.
+  std::vector<int> first_values(1, 0);
+  std::vector<int> second_values(1, 0);
 
   if (simulate_method == "pagefault") {
-    PageFaultSimulation* page_fault_simulation = new PageFaultSimulation();
-    DCHECK(page_fault_simulation != NULL);
-    simulation.reset(page_fault_simulation);
-
-    int page_size = 0;
-    int pages_per_code_fault = 0;
-    StringType page_size_str = cmd_line->GetSwitchValueNative("page-size");
-    StringType pages_per_code_fault_str =
-        cmd_line->GetSwitchValueNative("pages-per-code-fault");
-
-    if (!page_size_str.empty()) {
-      if (!base::StringToInt(page_size_str, &page_size))
-        return Usage("Invalid page-size value.");
-      else
-        page_fault_simulation->set_page_size(page_size);
-    }
-
-    if (!pages_per_code_fault_str.empty()) {
-      if (!base::StringToInt(pages_per_code_fault_str, &pages_per_code_fault))
-        return Usage("Invalid pages-per-code-fault value.");
-      else
-        page_fault_simulation->set_pages_per_code_fault(pages_per_code_fault);
-    }
+    if (!ParseIntList(cmd_line, "page-size", &first_values))
+      return Usage("Invalid page-size value.");
+    if (!ParseIntList(cmd_line, "pages-per-code-fault", &second_values))
+      return Usage("Invalid pages-per-code-fault value.");
   } else if (simulate_method == "heatmap") {
-    HeatMapSimulation* heat_map_simulation = new HeatMapSimulation();
-    DCHECK(heat_map_simulation != NULL);
-    simulation.reset(heat_map_simulation);
-
-    int time_slice_usecs = 0;
-    int memory_slice_bytes = 0;
-    StringType time_slice_usecs_str =
-        cmd_line->GetSwitchValueNative("time-slice-usecs");
-    StringType memory_slice_bytes_str =
-        cmd_line->GetSwitchValueNative("memory-slice-bytes");
-
-    if (!time_slice_usecs_str.empty()) {
-      if (!base::StringToInt(time_slice_usecs_str, &time_slice_usecs))
-        return Usage("Invalid time-slice-usecs value.");
-      else
-        heat_map_simulation->set_time_slice_usecs(time_slice_usecs);
-    }
+    if (!ParseIntList(cmd_line, "time-slice-usecs", &first_values))
+      return Usage("Invalid time-slice-usecs value.");
+    if (!ParseIntList(cmd_line, "memory-slice-bytes", &second_values))
+      return Usage("Invalid memory-slice-bytes value.");
+  } else if (simulate_method == "cache") {
+    if (!ParseIntList(cmd_line, "cache-size", &first_values))
+      return Usage("Invalid cache-size value.");
+    if (!ParseIntList(cmd_line, "cache-associativity", &second_values))
+      return Usage("Invalid cache-associativity value.");
+  } else {
+    return Usage("Invalid simulate-method value.");
+  }
+
+  // The parameters of the cache method that take a single value.
+  int cache_line_size = CacheSimulation::kDefaultCacheLineSize;
+  int tlb_entries = CacheSimulation::kDefaultTlbEntries;
+  int tlb_associativity = CacheSimulation::kDefaultTlbAssociativity;
+  int page_size = 0;
+  if (simulate_method == "cache") {
+    if (!ParseInt(cmd_line, "cache-line-size", &cache_line_size))
+      return Usage("Invalid cache-line-size value.");
+    if (!ParseInt(cmd_line, "tlb-entries", &tlb_entries))
+      return Usage("Invalid tlb-entries value.");
+    if (!ParseInt(cmd_line, "tlb-associativity", &tlb_associativity))
+      return Usage("Invalid tlb-associativity value.");
+    if (!ParseInt(cmd_line, "page-size", &page_size))
+      return Usage("Invalid page-size value.");
+    if (tlb_entries % tlb_associativity != 0)
+      return Usage("tlb-entries must be a multiple of tlb-associativity.");
+  }
+
+  // The parameters of the heat map method that take a single value. A value
+  // of zero leaves the output unbounded.
+  int max_time_slices = 0;
+  int max_memory_slices = 0;
+  if (simulate_method == "heatmap") {
+    if (!ParseInt(cmd_line, "max-time-slices", &max_time_slices))
+      return Usage("Invalid max-time-slices value.");
+    if (!ParseInt(cmd_line, "max-memory-slices", &max_memory_slices))
+      return Usage("Invalid max-memory-slices value.");
+  }
+
+  int num_threads = 0;
+  std::string num_threads_str = cmd_line->GetSwitchValueASCII("num-threads");
+  if (!num_threads_str.empty() &&
+      (!base::StringToInt(num_threads_str, &num_threads) || num_threads <= 0)) {
+    return Usage("Invalid num-threads value.");
+  }
 
-    if (!memory_slice_bytes_str.empty()) {
-      if (!base::StringToInt(memory_slice_bytes_str, &memory_slice_bytes))
-        return Usage("Invalid memory-slice-bytes value.");
-      else
-        heat_map_simulation->set_memory_slice_bytes(memory_slice_bytes);
+  // Each combination of values gets its own simulation.
+  ScopedVector<SimulationEventHandler> configurations;
+  for (size_t i = 0; i < first_values.size(); ++i) {
+    for (size_t j = 0; j < second_values.size(); ++j) {
+      if (simulate_method == "pagefault") {
+        PageFaultSimulation* page_fault_simulation = new PageFaultSimulation();
+        configurations.push_back(page_fault_simulation);
+
+        if (first_values[i] != 0)
+          page_fault_simulation->set_page_size(first_values[i]);
+        if (second_values[j] != 0)
+          page_fault_simulation->set_pages_per_code_fault(second_values[j]);
+      } else if (simulate_method == "heatmap") {
+        HeatMapSimulation* heat_map_simulation = new HeatMapSimulation();
+        configurations.push_back(heat_map_simulation);
+
+        if (first_values[i] != 0)
+          heat_map_simulation->set_time_slice_usecs(first_values[i]);
+        if (second_values[j] != 0)
+          heat_map_simulation->set_memory_slice_bytes(second_values[j]);
+        heat_map_simulation->set_output_individual_functions(
+            cmd_line->HasSwitch("output-individual-functions"));
+        heat_map_simulation->set_max_output_time_slices(max_time_slices);
+        heat_map_simulation->set_max_output_memory_slices(max_memory_slices);
+      } else {
+        CacheSimulation* cache_simulation = new CacheSimulation();
+        configurations.push_back(cache_simulation);
+
+        size_t cache_size = first_values[i] != 0 ?
+            first_values[i] : CacheSimulation::kDefaultCacheSize;
+        size_t cache_associativity = second_values[j] != 0 ?
+            second_values[j] : CacheSimulation::kDefaultCacheAssociativity;
+        if (cache_size % (cache_associativity * cache_line_size) != 0) {
+          return Usage("cache-size must be a multiple of cache-line-size "
+                       "times cache-associativity.");
+        }
+
+        cache_simulation->set_cache_size(cache_size);
+        cache_simulation->set_cache_associativity(cache_associativity);
+        cache_simulation->set_cache_line_size(cache_line_size);
+        cache_simulation->set_tlb_entries(tlb_entries);
+        cache_simulation->set_tlb_associativity(tlb_associativity);
+        if (page_size != 0)
+          cache_simulation->set_page_size(page_size);
+      }
     }
+  }
+  DCHECK(!configurations.empty());
 
-    heat_map_simulation->set_output_individual_functions(
-        cmd_line->HasSwitch("output-individual-functions"));
+  // A single configuration is fed directly by the simulator. Several
+  // configurations share a single parse of the trace files, and are then run
+  // in parallel.
+  scoped_ptr<SimulationEventHandler> simulation;
+  SimulationSet* simulation_set = NULL;
+  if (configurations.size() == 1) {
+    simulation.reset(configurations[0]);
+    configurations.weak_clear();
   } else {
-    return Usage("Invalid simulate-method value.");
+    simulation_set = new SimulationSet();
+    simulation.reset(simulation_set);
+    if (num_threads != 0)
+      simulation_set->set_num_threads(num_threads);
+    for (size_t i = 0; i < configurations.size(); ++i)
+      simulation_set->AddSimulation(configurations[i]);
+    configurations.weak_clear();
   }
 
-
   Simulator simulator(input_dll_path,
                       instrumented_dll_path,
                       trace_paths,
                       simulation.get());
+  simulator.set_scenarios(scenarios);
 
   LOG(INFO) << "Parsing trace files.";
   if (!simulator.ParseTraceFiles()) {
@@ -164,6 +325,12 @@ int main(int argc, char** argv) {
     return 1;
   }
 
+  if (simulation_set != NULL) {
+    LOG(INFO) << "Running " << simulation_set->simulations().size()
+              << " simulations.";
+    simulation_set->Simulate();
+  }
+
   file_util::ScopedFILE output_file;
   FILE* output = NULL;
   if (output_file_path.empty()) {
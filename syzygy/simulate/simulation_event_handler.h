@@ -17,6 +17,8 @@
 #ifndef SYZYGY_SIMULATE_SIMULATION_EVENT_HANDLER_H_
 #define SYZYGY_SIMULATE_SIMULATION_EVENT_HANDLER_H_
 
+#include <string>
+
 #include "base/time.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
@@ -29,6 +31,11 @@ namespace simulate {
 // in ParseEventHandler.
 class SimulationEventHandler {
  public:
+  // Issued before the trace files of each scenario are processed, when the
+  // simulator is given scenarios.
+  // @param name The name of the scenario.
+  virtual void OnScenarioStarted(const std::string& name) {}
+
   // Issued once, prior to the first OnFunctionEntry event in each
   // instrumented module.
   // @param time The entry time of this process.
@@ -0,0 +1,175 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/simulate/simulation_set.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
+
+namespace simulate {
+
+// Replays the recorded events to a single simulation. Simulations only share
+// the events and blocks, which are read-only while they run.
+class SimulationSet::Replayer : public base::DelegateSimpleThread::Delegate {
+ public:
+  Replayer(const SimulationSet* set, SimulationEventHandler* simulation)
+      : set_(set), simulation_(simulation) {
+    DCHECK(set != NULL);
+    DCHECK(simulation != NULL);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  virtual void Run() OVERRIDE;
+  // @}
+
+ private:
+  const SimulationSet* set_;
+  SimulationEventHandler* simulation_;
+
+  DISALLOW_COPY_AND_ASSIGN(Replayer);
+};
+
+void SimulationSet::Replayer::Run() {
+  const EventVector& events = set_->events_;
+  for (size_t i = 0; i < events.size(); ++i) {
+    const Event& event = events[i];
+    base::Time time = base::Time::FromInternalValue(event.time);
+    switch (event.type) {
+      case Event::kScenarioStarted:
+        simulation_->OnScenarioStarted(set_->scenario_names_[event.value]);
+        break;
+
+      case Event::kProcessStarted:
+        simulation_->OnProcessStarted(time, event.value);
+        break;
+
+      case Event::kFunctionEntry:
+        simulation_->OnFunctionEntry(time, set_->blocks_[event.value]);
+        break;
+
+      default:
+        NOTREACHED() << "Unknown event type: " << event.type << ".";
+    }
+  }
+}
+
+SimulationSet::SimulationSet()
+    : num_threads_(base::SysInfo::NumberOfProcessors()) {
+}
+
+SimulationSet::~SimulationSet() {
+}
+
+void SimulationSet::AddSimulation(SimulationEventHandler* simulation) {
+  DCHECK(simulation != NULL);
+  simulations_.push_back(simulation);
+}
+
+void SimulationSet::set_num_threads(size_t num_threads) {
+  num_threads_ = std::max(num_threads, static_cast<size_t>(1));
+}
+
+void SimulationSet::ReplaceBlocks(const BlockMap& replacements) {
+  for (size_t i = 0; i < blocks_.size(); ++i) {
+    BlockMap::const_iterator it = replacements.find(blocks_[i]);
+    if (it != replacements.end()) {
+      DCHECK(it->second != NULL);
+      blocks_[i] = it->second;
+    }
+  }
+
+  // Keep the block ids consistent, should more events be recorded.
+  block_ids_.clear();
+  for (size_t i = 0; i < blocks_.size(); ++i)
+    block_ids_[blocks_[i]] = i;
+}
+
+void SimulationSet::Simulate() {
+  if (simulations_.empty())
+    return;
+
+  LOG(INFO) << "Simulating " << events_.size() << " events on "
+            << blocks_.size() << " blocks with " << simulations_.size()
+            << " simulations.";
+
+  ScopedVector<Replayer> replayers;
+  for (size_t i = 0; i < simulations_.size(); ++i)
+    replayers.push_back(new Replayer(this, simulations_[i]));
+
+  // A single simulation doesn't need any extra thread.
+  size_t num_threads = std::min(num_threads_, replayers.size());
+  if (num_threads == 1) {
+    for (size_t i = 0; i < replayers.size(); ++i)
+      replayers[i]->Run();
+    return;
+  }
+
+  base::DelegateSimpleThreadPool pool("SimulationSet",
+                                      static_cast<int>(num_threads));
+  pool.Start();
+  for (size_t i = 0; i < replayers.size(); ++i)
+    pool.AddWork(replayers[i]);
+  pool.JoinAll();
+}
+
+void SimulationSet::OnScenarioStarted(const std::string& name) {
+  AddEvent(Event::kScenarioStarted, base::Time(), scenario_names_.size());
+  scenario_names_.push_back(name);
+}
+
+void SimulationSet::OnProcessStarted(base::Time time,
+                                     size_t default_page_size) {
+  AddEvent(Event::kProcessStarted, time, default_page_size);
+}
+
+void SimulationSet::OnFunctionEntry(base::Time time, const Block* block) {
+  DCHECK(block != NULL);
+
+  std::pair<std::map<const Block*, uint32>::iterator, bool> result =
+      block_ids_.insert(std::make_pair(block, blocks_.size()));
+  if (result.second)
+    blocks_.push_back(block);
+
+  AddEvent(Event::kFunctionEntry, time, result.first->second);
+}
+
+bool SimulationSet::SerializeToJSON(FILE* output, bool pretty_print) {
+  DCHECK(output != NULL);
+
+  // Each simulation writes a complete JSON value of its own, so the list is
+  // written around them.
+  if (::fputs(pretty_print ? "[\n" : "[", output) < 0)
+    return false;
+  for (size_t i = 0; i < simulations_.size(); ++i) {
+    if (i > 0 && ::fputs(pretty_print ? ",\n" : ",", output) < 0)
+      return false;
+    if (!simulations_[i]->SerializeToJSON(output, pretty_print))
+      return false;
+  }
+  if (::fputs(pretty_print ? "\n]\n" : "]", output) < 0)
+    return false;
+
+  return true;
+}
+
+void SimulationSet::AddEvent(Event::Type type, base::Time time, uint32 value) {
+  Event event = { time.ToInternalValue(), value, type };
+  events_.push_back(event);
+}
+
+}  // namespace simulate
@@ -0,0 +1,137 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file declares the SimulationSet class, which feeds the events of a
+// single parse of the trace files to several simulations.
+
+#ifndef SYZYGY_SIMULATE_SIMULATION_SET_H_
+#define SYZYGY_SIMULATE_SIMULATION_SET_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/memory/scoped_vector.h"
+#include "syzygy/simulate/simulation_event_handler.h"
+
+namespace simulate {
+
+// An implementation of SimulationEventHandler that drives a set of
+// simulations, typically the same simulation with different parameters. The
+// events are recorded in a compact form while the trace files are parsed, and
+// are then replayed to each of the simulations, in parallel. Sample usage:
+//
+// SimulationSet simulations;
+// simulations.AddSimulation(new PageFaultSimulation());
+// simulations.AddSimulation(new PageFaultSimulation());
+//
+// Simulator simulator(module, instrumented_module, traces, &simulations);
+// simulator.ParseTraceFiles();
+// simulations.Simulate();
+// simulations.SerializeToJSON(file, pretty_print);
+class SimulationSet : public SimulationEventHandler {
+ public:
+  typedef block_graph::BlockGraph::Block Block;
+  typedef std::map<const Block*, const Block*> BlockMap;
+
+  SimulationSet();
+  ~SimulationSet();
+
+  // Adds a simulation to the set.
+  // @param simulation the simulation to add. The set takes ownership of it.
+  void AddSimulation(SimulationEventHandler* simulation);
+
+  // Substitutes blocks in the events recorded so far. This allows simulating
+  // the same events on another layout of the image.
+  // @param replacements the blocks to replace, and their replacements. The
+  //     blocks that aren't in this map are left as they are.
+  void ReplaceBlocks(const BlockMap& replacements);
+
+  // Replays the events recorded so far to each of the simulations. This can
+  // only be called once.
+  void Simulate();
+
+  // @name Accessors
+  // @{
+  const std::vector<SimulationEventHandler*>& simulations() const {
+    return simulations_.get();
+  }
+  size_t num_events() const { return events_.size(); }
+  // @}
+
+  // Sets the number of threads used to run the simulations. This defaults to
+  // the number of processors.
+  // @param num_threads the number of threads. At least one thread is used.
+  void set_num_threads(size_t num_threads);
+
+  // @name SimulationEventHandler implementation
+  // @{
+  // These record the events, to be replayed by Simulate.
+  virtual void OnScenarioStarted(const std::string& name) OVERRIDE;
+  virtual void OnProcessStarted(base::Time time,
+                                size_t default_page_size) OVERRIDE;
+  virtual void OnFunctionEntry(base::Time time, const Block* block) OVERRIDE;
+
+  // The serialization consists of a list containing the serialization of
+  // each simulation, in the order they were added.
+  virtual bool SerializeToJSON(FILE* output, bool pretty_print) OVERRIDE;
+  // @}
+
+ private:
+  // A recorded event.
+  struct Event {
+    enum Type {
+      kScenarioStarted,
+      kProcessStarted,
+      kFunctionEntry,
+    };
+
+    // The time of the event, as given by base::Time::ToInternalValue.
+    int64 time;
+    // The index of the block for function entries, the default page size for
+    // process starts, and the index of the scenario name for scenario starts.
+    uint32 value;
+    // One of the Type values.
+    uint32 type;
+  };
+  typedef std::vector<Event> EventVector;
+
+  // Replays the recorded events to a simulation.
+  class Replayer;
+
+  // Records an event.
+  void AddEvent(Event::Type type, base::Time time, uint32 value);
+
+  // The simulations, in the order they were added.
+  ScopedVector<SimulationEventHandler> simulations_;
+
+  // The recorded events.
+  EventVector events_;
+
+  // The blocks referred to by the function entry events, and their indices.
+  std::vector<const Block*> blocks_;
+  std::map<const Block*, uint32> block_ids_;
+
+  // The names of the scenarios referred to by the scenario events.
+  std::vector<std::string> scenario_names_;
+
+  // The number of threads used to run the simulations.
+  size_t num_threads_;
+
+  DISALLOW_COPY_AND_ASSIGN(SimulationSet);
+};
+
+}  // namespace simulate
+
+#endif  // SYZYGY_SIMULATE_SIMULATION_SET_H_
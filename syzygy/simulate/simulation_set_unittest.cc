@@ -0,0 +1,164 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/simulate/simulation_set.h"
+
+#include "base/file_util.h"
+#include "base/stringprintf.h"
+#include "base/files/scoped_temp_dir.h"
+#include "gtest/gtest.h"
+
+namespace simulate {
+
+namespace {
+
+using block_graph::BlockGraph;
+
+// A simulation that records the events it receives as strings.
+class RecordingSimulation : public SimulationEventHandler {
+ public:
+  explicit RecordingSimulation(int id) : id_(id) {
+  }
+
+  virtual void OnScenarioStarted(const std::string& name) OVERRIDE {
+    events_.push_back("scenario " + name);
+  }
+
+  virtual void OnProcessStarted(base::Time time,
+                                size_t default_page_size) OVERRIDE {
+    events_.push_back(base::StringPrintf("process %lld %d",
+                                         time.ToInternalValue(),
+                                         static_cast<int>(default_page_size)));
+  }
+
+  virtual void OnFunctionEntry(base::Time time,
+                               const BlockGraph::Block* block) OVERRIDE {
+    events_.push_back(base::StringPrintf("entry %lld %s",
+                                         time.ToInternalValue(),
+                                         block->name().c_str()));
+  }
+
+  virtual bool SerializeToJSON(FILE* output, bool pretty_print) OVERRIDE {
+    return ::fprintf(output, "%d", id_) >= 0;
+  }
+
+  const std::vector<std::string>& events() const { return events_; }
+
+ private:
+  int id_;
+  std::vector<std::string> events_;
+};
+
+class SimulationSetTest : public testing::Test {
+ public:
+  SimulationSetTest() : block1_(NULL), block2_(NULL) {
+  }
+
+  virtual void SetUp() OVERRIDE {
+    block1_ = block_graph_.AddBlock(BlockGraph::CODE_BLOCK, 0x10, "block1");
+    block2_ = block_graph_.AddBlock(BlockGraph::CODE_BLOCK, 0x20, "block2");
+  }
+
+  // Sends the same sequence of events to @p simulation.
+  void SendEvents(SimulationEventHandler* simulation) {
+    simulation->OnScenarioStarted("startup");
+    simulation->OnProcessStarted(base::Time::FromInternalValue(10), 4096);
+    simulation->OnFunctionEntry(base::Time::FromInternalValue(11), block1_);
+    simulation->OnFunctionEntry(base::Time::FromInternalValue(12), block2_);
+    simulation->OnScenarioStarted("shutdown");
+    simulation->OnProcessStarted(base::Time::FromInternalValue(20), 8192);
+    simulation->OnFunctionEntry(base::Time::FromInternalValue(21), block2_);
+    simulation->OnFunctionEntry(base::Time::FromInternalValue(22), block1_);
+  }
+
+ protected:
+  BlockGraph block_graph_;
+  BlockGraph::Block* block1_;
+  BlockGraph::Block* block2_;
+};
+
+}  // namespace
+
+TEST_F(SimulationSetTest, ReplaysEventsToEachSimulation) {
+  RecordingSimulation expected_simulation(0);
+  SendEvents(&expected_simulation);
+
+  SimulationSet simulations;
+  simulations.set_num_threads(2);
+  for (int i = 0; i < 5; ++i)
+    simulations.AddSimulation(new RecordingSimulation(i));
+
+  SendEvents(&simulations);
+  EXPECT_EQ(8U, simulations.num_events());
+
+  // Nothing is sent to the simulations until they are run.
+  for (size_t i = 0; i < simulations.simulations().size(); ++i) {
+    RecordingSimulation* simulation =
+        static_cast<RecordingSimulation*>(simulations.simulations()[i]);
+    EXPECT_TRUE(simulation->events().empty());
+  }
+
+  simulations.Simulate();
+
+  for (size_t i = 0; i < simulations.simulations().size(); ++i) {
+    RecordingSimulation* simulation =
+        static_cast<RecordingSimulation*>(simulations.simulations()[i]);
+    EXPECT_EQ(expected_simulation.events(), simulation->events());
+  }
+}
+
+TEST_F(SimulationSetTest, ReplaceBlocks) {
+  BlockGraph::Block* block3 =
+      block_graph_.AddBlock(BlockGraph::CODE_BLOCK, 0x10, "block3");
+
+  SimulationSet simulations;
+  simulations.AddSimulation(new RecordingSimulation(0));
+  SendEvents(&simulations);
+
+  SimulationSet::BlockMap replacements;
+  replacements[block1_] = block3;
+  simulations.ReplaceBlocks(replacements);
+  simulations.Simulate();
+
+  RecordingSimulation* simulation =
+      static_cast<RecordingSimulation*>(simulations.simulations()[0]);
+  ASSERT_EQ(8U, simulation->events().size());
+  EXPECT_EQ("entry 11 block3", simulation->events()[2]);
+  EXPECT_EQ("entry 12 block2", simulation->events()[3]);
+  EXPECT_EQ("entry 22 block3", simulation->events()[7]);
+}
+
+TEST_F(SimulationSetTest, SerializeToJSON) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath path = temp_dir.path().AppendASCII("output.json");
+
+  SimulationSet simulations;
+  simulations.AddSimulation(new RecordingSimulation(1));
+  simulations.AddSimulation(new RecordingSimulation(2));
+  simulations.AddSimulation(new RecordingSimulation(3));
+  simulations.Simulate();
+
+  {
+    file_util::ScopedFILE output(file_util::OpenFile(path, "w"));
+    ASSERT_TRUE(output.get() != NULL);
+    ASSERT_TRUE(simulations.SerializeToJSON(output.get(), false));
+  }
+
+  std::string contents;
+  ASSERT_TRUE(file_util::ReadFileToString(path, &contents));
+  EXPECT_EQ("[1,2,3]", contents);
+}
+
+}  // namespace simulate
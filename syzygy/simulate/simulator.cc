@@ -53,9 +53,20 @@ bool Simulator::ParseTraceFiles() {
     return false;
   }
 
-  if (!parser_->Consume()) {
-    playback_.reset();
-    return false;
+  if (scenarios_.empty()) {
+    if (!parser_->Consume()) {
+      playback_.reset();
+      return false;
+    }
+  } else {
+    DCHECK(trace_files_.empty());
+    for (size_t i = 0; i < scenarios_.size(); ++i) {
+      simulation_->OnScenarioStarted(scenarios_[i].name);
+      if (!playback::ConsumeScenario(scenarios_[i], parser_.get())) {
+        playback_.reset();
+        return false;
+      }
+    }
   }
 
   playback_.reset();
@@ -111,4 +122,39 @@ void Simulator::OnBatchFunctionEntry(base::Time time,
   }
 }
 
+bool Simulator::WantsFunctionEntryBatches() {
+  return true;
+}
+
+void Simulator::OnFunctionEntryBatch(
+    DWORD process_id,
+    DWORD thread_id,
+    const trace::parser::FunctionEntryEvent* events,
+    size_t num_events) {
+  DCHECK(playback_ != NULL);
+  DCHECK(simulation_ != NULL);
+  DCHECK(events != NULL);
+
+  // Runs of entries commonly repeat the same function, so reuse the last
+  // lookup when they do.
+  FuncAddr last_function = NULL;
+  const BlockGraph::Block* block = NULL;
+  for (size_t i = 0; i < num_events; ++i) {
+    if (i == 0 || events[i].function != last_function) {
+      bool error = false;
+      block = playback_->FindFunctionBlock(
+          process_id, events[i].function, &error);
+      if (error) {
+        LOG(ERROR) << "Playback::FindFunctionBlock failed.";
+        parser_->set_error_occurred(true);
+        return;
+      }
+      last_function = events[i].function;
+    }
+
+    if (block != NULL)
+      simulation_->OnFunctionEntry(events[i].time, block);
+  }
+}
+
 }  // namespace simulate
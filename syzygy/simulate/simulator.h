@@ -20,6 +20,7 @@
 #define SYZYGY_SIMULATE_SIMULATOR_H_
 
 #include "syzygy/playback/playback.h"
+#include "syzygy/playback/scenario.h"
 #include "syzygy/simulate/simulation_event_handler.h"
 #include "syzygy/trace/parse/parser.h"
 
@@ -31,6 +32,7 @@ class Simulator : public trace::parser::ParseEventHandlerImpl {
  public:
   typedef playback::Playback Playback;
   typedef Playback::TraceFileList TraceFileList;
+  typedef playback::ScenarioVector ScenarioVector;
 
   // Construct a new Simulator instance.
   // @param module_path The path of the module dll.
@@ -42,11 +44,26 @@ class Simulator : public trace::parser::ParseEventHandlerImpl {
             const TraceFileList& trace_files,
             SimulationEventHandler* simulation);
 
+  // Sets the scenarios whose trace files are to be parsed. Each scenario is
+  // parsed in turn, after notifying the simulation. This is used instead of
+  // the trace files given at construction, which must be empty.
+  // @param scenarios The scenarios to simulate.
+  void set_scenarios(const ScenarioVector& scenarios) {
+    scenarios_ = scenarios;
+  }
+
   // Decomposes the image, parses the trace files and captures
   // the pagefaults on them.
   // @returns true on success, false on failure.
   bool ParseTraceFiles();
 
+  // @name Accessors
+  // These are populated by ParseTraceFiles.
+  // @{
+  const pe::PEFile& pe_file() const { return pe_file_; }
+  const pe::ImageLayout& image_layout() const { return image_layout_; }
+  // @}
+
  protected:
   typedef block_graph::BlockGraph BlockGraph;
   typedef pe::PEFile PEFile;
@@ -64,12 +81,18 @@ class Simulator : public trace::parser::ParseEventHandlerImpl {
   virtual void OnBatchFunctionEntry(
       base::Time time, DWORD process_id, DWORD thread_id,
       const TraceBatchEnterData* data) OVERRIDE;
+  virtual bool WantsFunctionEntryBatches() OVERRIDE;
+  virtual void OnFunctionEntryBatch(
+      DWORD process_id, DWORD thread_id,
+      const trace::parser::FunctionEntryEvent* events,
+      size_t num_events) OVERRIDE;
   // @}
 
   // The input files.
   base::FilePath module_path_;
   base::FilePath instrumented_path_;
   TraceFileList trace_files_;
+  ScenarioVector scenarios_;
 
   // The PE file and Image layout to be passed to playback_.
   BlockGraph block_graph_;
@@ -0,0 +1,131 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/simulate/working_set_simulation.h"
+
+#include "syzygy/core/json_file_writer.h"
+
+namespace simulate {
+
+WorkingSetSimulation::WorkingSetSimulation()
+    : page_size_(0), process_count_(0), in_process_(false) {
+}
+
+void WorkingSetSimulation::AddTimeLimit(base::TimeDelta time_limit) {
+  DCHECK(!in_process_);
+
+  WorkingSet working_set;
+  working_set.time_limit = time_limit;
+
+  WorkingSetVector::iterator it = working_sets_.begin();
+  while (it != working_sets_.end() && it->time_limit < time_limit)
+    ++it;
+  if (it != working_sets_.end() && it->time_limit == time_limit)
+    return;
+  working_sets_.insert(it, working_set);
+}
+
+void WorkingSetSimulation::Finish() {
+  if (!in_process_)
+    return;
+
+  ++process_count_;
+  PageTimeMap::const_iterator it = first_touches_.begin();
+  for (; it != first_touches_.end(); ++it) {
+    base::TimeDelta touch_time = it->second - process_start_;
+    for (size_t i = 0; i < working_sets_.size(); ++i) {
+      if (touch_time < working_sets_[i].time_limit)
+        ++working_sets_[i].total_pages;
+    }
+  }
+
+  in_process_ = false;
+  first_touches_.clear();
+}
+
+void WorkingSetSimulation::OnProcessStarted(base::Time time,
+                                            size_t default_page_size) {
+  if (page_size_ == 0) {
+    if (default_page_size != 0)
+      page_size_ = default_page_size;
+    else
+      page_size_ = kDefaultPageSize;
+
+    LOG(INFO) << "Page size set to " << page_size_;
+  }
+
+  Finish();
+  in_process_ = true;
+  process_start_ = time;
+}
+
+void WorkingSetSimulation::OnFunctionEntry(base::Time time,
+                                           const Block* block) {
+  DCHECK(block != NULL);
+  DCHECK_NE(0U, page_size_);
+  DCHECK(in_process_);
+
+  if (block->size() == 0)
+    return;
+
+  // Only the first touch of each page matters, and the events are ordered by
+  // time.
+  const uint32 kStartPage = block->addr().value() / page_size_;
+  const uint32 kEndPage =
+      (block->addr().value() + block->size() - 1) / page_size_ + 1;
+  for (uint32 page = kStartPage; page < kEndPage; ++page)
+    first_touches_.insert(std::make_pair(page, time));
+}
+
+bool WorkingSetSimulation::SerializeToJSON(FILE* output, bool pretty_print) {
+  DCHECK(output != NULL);
+  Finish();
+
+  core::JSONFileWriter json_file(output, pretty_print);
+  if (!json_file.OpenDict() ||
+      !json_file.OutputKey("page_size") ||
+      !json_file.OutputInteger(page_size_) ||
+      !json_file.OutputKey("process_count") ||
+      !json_file.OutputInteger(process_count_) ||
+      !json_file.OutputKey("working_sets") ||
+      !json_file.OpenList()) {
+    return false;
+  }
+
+  for (size_t i = 0; i < working_sets_.size(); ++i) {
+    double average_pages = 0.0;
+    if (process_count_ != 0) {
+      average_pages = static_cast<double>(working_sets_[i].total_pages) /
+          process_count_;
+    }
+
+    if (!json_file.OpenDict() ||
+        !json_file.OutputKey("time_limit_ms") ||
+        !json_file.OutputInteger(static_cast<int>(
+            working_sets_[i].time_limit.InMilliseconds())) ||
+        !json_file.OutputKey("average_pages") ||
+        !json_file.OutputDouble(average_pages) ||
+        !json_file.CloseDict()) {
+      return false;
+    }
+  }
+
+  if (!json_file.CloseList() || !json_file.CloseDict())
+    return false;
+
+  DCHECK(json_file.Finished());
+  return true;
+}
+
+}  // namespace simulate
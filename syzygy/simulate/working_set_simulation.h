@@ -0,0 +1,129 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file declares the WorkingSetSimulation class.
+
+#ifndef SYZYGY_SIMULATE_WORKING_SET_SIMULATION_H_
+#define SYZYGY_SIMULATE_WORKING_SET_SIMULATION_H_
+
+#include <map>
+#include <vector>
+
+#include "syzygy/simulate/simulation_event_handler.h"
+
+namespace simulate {
+
+// An implementation of SimulationEventHandler. WorkingSetSimulation measures
+// the number of distinct code pages each process has touched after given
+// amounts of time, that is the size of its working set early on. Sample
+// usage:
+//
+// WorkingSetSimulation simulation;
+//
+// simulation.AddTimeLimit(base::TimeDelta::FromMilliseconds(100));
+// simulation.AddTimeLimit(base::TimeDelta::FromMilliseconds(1000));
+// simulation.OnProcessStarted(time, 0);
+// simulation.OnFunctionEntry(time, block1);
+// simulation.OnFunctionEntry(time, block2);
+// simulation.SerializeToJSON(file, pretty_print);
+//
+// If the page size isn't set, it is deduced from the trace file data or, if
+// that's not possible, it's set to the default value of 0x1000 (4 KB).
+class WorkingSetSimulation : public SimulationEventHandler {
+ public:
+  typedef block_graph::BlockGraph::Block Block;
+
+  // The working set at a given time.
+  struct WorkingSet {
+    WorkingSet() : total_pages(0) {}
+
+    // The time since the start of the processes.
+    base::TimeDelta time_limit;
+    // The sum of the sizes of the working sets of each process, in pages.
+    size_t total_pages;
+  };
+  typedef std::vector<WorkingSet> WorkingSetVector;
+
+  // The default page size, in case neither the user nor the system provide
+  // one.
+  static const size_t kDefaultPageSize = 0x1000;
+
+  WorkingSetSimulation();
+
+  // Adds a time at which to measure the working sets. The time limits must be
+  // added before the simulation starts.
+  // @param time_limit the time since the start of the processes.
+  void AddTimeLimit(base::TimeDelta time_limit);
+
+  // @name Accessors
+  // @{
+  size_t page_size() const { return page_size_; }
+  size_t process_count() const { return process_count_; }
+  // @returns the working sets, by increasing time limit. The last process is
+  //     only accounted for once the simulation has been serialized, or once
+  //     Finish has been called.
+  const WorkingSetVector& working_sets() const { return working_sets_; }
+  // @}
+
+  // @name Mutators
+  // @{
+  void set_page_size(size_t page_size) {
+    DCHECK_LT(0U, page_size);
+    page_size_ = page_size;
+  }
+  // @}
+
+  // Accounts for the working set of the last process.
+  void Finish();
+
+  // @name SimulationEventHandler implementation
+  // @{
+  // Sets the page size, if it's not set already, and starts measuring the
+  // working set of a new process.
+  virtual void OnProcessStarted(base::Time time,
+                                size_t default_page_size) OVERRIDE;
+
+  // Touches the pages of a code block.
+  virtual void OnFunctionEntry(base::Time time, const Block* block) OVERRIDE;
+
+  // The serialization consists of a single dictionary containing the number
+  // of processes and, for each time limit, the average size of their working
+  // sets.
+  virtual bool SerializeToJSON(FILE* output, bool pretty_print) OVERRIDE;
+  // @}
+
+ private:
+  // The time at which each page was first touched by the current process.
+  typedef std::map<uint32, base::Time> PageTimeMap;
+
+  // The size of each page, in bytes.
+  size_t page_size_;
+
+  // The number of processes accounted for.
+  size_t process_count_;
+
+  // The working sets, by increasing time limit.
+  WorkingSetVector working_sets_;
+
+  // The state of the current process.
+  bool in_process_;
+  base::Time process_start_;
+  PageTimeMap first_touches_;
+
+  DISALLOW_COPY_AND_ASSIGN(WorkingSetSimulation);
+};
+
+}  // namespace simulate
+
+#endif  // SYZYGY_SIMULATE_WORKING_SET_SIMULATION_H_
@@ -0,0 +1,78 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/simulate/working_set_simulation.h"
+
+#include "gtest/gtest.h"
+
+namespace simulate {
+
+namespace {
+
+using base::Time;
+using base::TimeDelta;
+using block_graph::BlockGraph;
+
+class WorkingSetSimulationTest : public testing::Test {
+ public:
+  const BlockGraph::Block* AddBlock(uint32 start, size_t size) {
+    BlockGraph::Block* block =
+        block_graph_.AddBlock(BlockGraph::CODE_BLOCK, size, "block");
+    block->set_addr(core::RelativeAddress(start));
+    return block;
+  }
+
+  // @returns the time @p ms milliseconds after @p start.
+  static Time After(Time start, int ms) {
+    return start + TimeDelta::FromMilliseconds(ms);
+  }
+
+ protected:
+  BlockGraph block_graph_;
+  WorkingSetSimulation simulation_;
+};
+
+}  // namespace
+
+TEST_F(WorkingSetSimulationTest, MeasuresWorkingSets) {
+  simulation_.AddTimeLimit(TimeDelta::FromMilliseconds(100));
+  simulation_.AddTimeLimit(TimeDelta::FromMilliseconds(10));
+  simulation_.AddTimeLimit(TimeDelta::FromMilliseconds(100));
+  ASSERT_EQ(2U, simulation_.working_sets().size());
+  EXPECT_EQ(10, simulation_.working_sets()[0].time_limit.InMilliseconds());
+  EXPECT_EQ(100, simulation_.working_sets()[1].time_limit.InMilliseconds());
+
+  // The first process touches pages 1 and 2 right away, then page 3, and
+  // page 1 again.
+  Time start = Time::Now();
+  simulation_.OnProcessStarted(start, 0x1000);
+  simulation_.OnFunctionEntry(After(start, 1), AddBlock(0x1800, 0x1000));
+  simulation_.OnFunctionEntry(After(start, 50), AddBlock(0x3000, 0x10));
+  simulation_.OnFunctionEntry(After(start, 60), AddBlock(0x1000, 0x10));
+  simulation_.OnFunctionEntry(After(start, 200), AddBlock(0x4000, 0x10));
+
+  // The second process touches page 5 late.
+  start = After(start, 1000);
+  simulation_.OnProcessStarted(start, 0x1000);
+  simulation_.OnFunctionEntry(After(start, 1), AddBlock(0x1000, 0x10));
+  simulation_.OnFunctionEntry(After(start, 20), AddBlock(0x5000, 0x10));
+
+  simulation_.Finish();
+  EXPECT_EQ(2U, simulation_.process_count());
+  EXPECT_EQ(0x1000U, simulation_.page_size());
+  EXPECT_EQ(3U, simulation_.working_sets()[0].total_pages);
+  EXPECT_EQ(5U, simulation_.working_sets()[1].total_pages);
+}
+
+}  // namespace simulate
@@ -21,6 +21,7 @@
 #include <dbghelp.h>
 
 #include "base/bind.h"
+#include "base/bind_helpers.h"
 #include "base/string_util.h"
 #include "base/stringprintf.h"
 #include "base/win/scoped_handle.h"
@@ -128,6 +129,9 @@ BOOL CALLBACK ReadProcessMemoryProc64(HANDLE process,
 AgentLogger::AgentLogger()
     : trace::common::Service(L"Logger"),
       destination_(NULL),
+      writer_thread_("AgentLogger writer"),
+      writer_is_running_(false),
+      flush_is_pending_(false),
       symbolize_stack_traces_(true) {
 }
 
@@ -147,6 +151,16 @@ bool AgentLogger::StartImpl() {
   if (!StartRpc())
     return false;
 
+  // Start the writer thread. If this fails the messages are simply written
+  // synchronously.
+  if (writer_thread_.Start()) {
+    base::AutoLock auto_lock(pending_output_lock_);
+    writer_is_running_ = true;
+  } else {
+    LOG(WARNING) << "Failed to start the writer thread, the log messages "
+                 << "will be written synchronously.";
+  }
+
   return true;
 }
 
@@ -161,10 +175,18 @@ bool AgentLogger::JoinImpl() {
   // this will simply ensure that all outstanding requests are handled. If
   // Stop has not been called, this will continue (i.e., block) handling events
   // until someone else calls Stop() in another thread.
-  if (!FinishRpc())
-    return false;
+  bool success = FinishRpc();
 
-  return true;
+  // No more messages can come in, drain the pending output.
+  {
+    base::AutoLock auto_lock(pending_output_lock_);
+    writer_is_running_ = false;
+  }
+  writer_thread_.Stop();
+  if (!FlushPendingOutput())
+    success = false;
+
+  return success;
 }
 
 bool AgentLogger::AppendTrace(HANDLE process,
@@ -307,24 +329,57 @@ bool AgentLogger::Write(const base::StringPiece& message) {
   if (message.empty())
     return true;
 
+  {
+    base::AutoLock auto_lock(pending_output_lock_);
+
+    pending_output_.append(message.data(), message.size());
+    if (message[message.size() - 1] != '\n')
+      pending_output_.push_back('\n');
+
+    if (writer_is_running_ &&
+        pending_output_.size() < kMaxPendingOutputSize) {
+      // The messages that come in before the flush task runs get written
+      // along with this one.
+      if (!flush_is_pending_) {
+        flush_is_pending_ = true;
+        writer_thread_.message_loop()->PostTask(
+            FROM_HERE,
+            base::Bind(base::IgnoreResult(&AgentLogger::FlushPendingOutput),
+                       base::Unretained(this)));
+      }
+      return true;
+    }
+  }
+
+  return FlushPendingOutput();
+}
+
+bool AgentLogger::FlushPendingOutput() {
   base::AutoLock auto_lock(write_lock_);
+  DCHECK(destination_ != NULL);
+
+  // Grab the pending output while holding write_lock_, so that the batches
+  // are written in order.
+  std::string output;
+  {
+    base::AutoLock pending_output_lock(pending_output_lock_);
+    output.swap(pending_output_);
+    flush_is_pending_ = false;
+  }
 
-  size_t chars_written = ::fwrite(message.data(),
+  if (output.empty())
+    return true;
+
+  size_t chars_written = ::fwrite(output.data(),
                                   sizeof(std::string::value_type),
-                                  message.size(),
+                                  output.size(),
                                   destination_);
 
-  if (chars_written != message.size()) {
+  if (chars_written != output.size()) {
     LOG(ERROR) << "Failed to write log message.";
     return false;
   }
 
-  if (message[message.size() - 1] != '\n' &&
-      ::fwrite("\n", 1, 1, destination_) != 1) {
-    LOG(ERROR) << "Failed to append trailing newline.";
-    return false;
-  }
-
   ::fflush(destination_);
 
   return true;
@@ -23,7 +23,9 @@
 #include "base/message_loop.h"
 #include "base/process.h"
 #include "base/string_piece.h"
+#include "base/synchronization/lock.h"
 #include "base/threading/platform_thread.h"
+#include "base/threading/thread.h"
 #include "syzygy/trace/common/service.h"
 #include "syzygy/trace/rpc/logger_rpc.h"
 
@@ -32,6 +34,11 @@ namespace agent_logger {
 
 // Implements the Logger interface (see "logger_rpc.idl").
 //
+// While the service is running the log messages are buffered in memory and
+// written to the destination in batches by a dedicated writer thread, so
+// that the RPC handlers of the different clients don't block each other on
+// the file output.
+//
 // Note: The Logger expects to be the only RPC service running in the process.
 class AgentLogger : public trace::common::Service {
  public:
@@ -80,10 +87,19 @@ class AgentLogger : public trace::common::Service {
                           CONTEXT* context,
                           std::vector<DWORD>* trace_data);
 
-  // Write @p message to the log destination. Note that calls to this method
-  // are serialized using write_lock_.
+  // Write @p message to the log destination. While the service is running
+  // the message is only appended to the pending output, which is written
+  // asynchronously. The pending output is flushed when the service stops.
+  // @param message The message to write. A trailing newline is appended if
+  //     it doesn't already end with one.
+  // @returns true on success, false otherwise.
   bool Write(const base::StringPiece& message);
 
+  // Write the pending output to the log destination. Note that calls to this
+  // method are serialized using write_lock_.
+  // @returns true on success, false otherwise.
+  bool FlushPendingOutput();
+
   // Generate a minidump for the calling process.
   // @param process An open handle to the running process.
   // @param pid The process id of the process to dump.
@@ -129,6 +145,26 @@ class AgentLogger : public trace::common::Service {
   // The lock used to serializes writes to destination_;
   base::Lock write_lock_;
 
+  // The size above which the pending output gets flushed synchronously by
+  // the writer, to bound the memory used by the buffer.
+  static const size_t kMaxPendingOutputSize = 1024 * 1024;
+
+  // The thread on which the pending output is written.
+  base::Thread writer_thread_;
+
+  // The lock protecting the pending output.
+  base::Lock pending_output_lock_;
+
+  // The messages waiting to be written to destination_.
+  std::string pending_output_;  // Under pending_output_lock_.
+
+  // True if the writer thread accepts flush tasks.
+  bool writer_is_running_;  // Under pending_output_lock_.
+
+  // True if a flush task has been posted to the writer thread and hasn't
+  // run yet.
+  bool flush_is_pending_;  // Under pending_output_lock_.
+
   // The lock used to serialize access to the debug help library used to
   // symbolize traces.
   base::Lock symbol_lock_;
@@ -20,6 +20,7 @@
 #include "base/stringprintf.h"
 #include "base/files/file_path.h"
 #include "base/files/scoped_temp_dir.h"
+#include "base/memory/scoped_vector.h"
 #include "base/threading/thread.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -75,8 +76,15 @@ bool TextContainsKnownStack(const std::string& text, size_t start_offset) {
 class TestLogger : public AgentLogger {
  public:
   using AgentLogger::destination_;
+  using AgentLogger::writer_is_running_;
 };
 
+void WriteNumberedLines(AgentLogger* logger, size_t thread_index,
+                        size_t line_count) {
+  for (size_t i = 0; i < line_count; ++i)
+    logger->Write(base::StringPrintf("Thread %d line %d", thread_index, i));
+}
+
 class LoggerTest : public testing::Test {
  public:
   MOCK_METHOD1(LoggerStartedCallback, bool(Service*));
@@ -263,6 +271,46 @@ TEST_F(LoggerTest, Write) {
   EXPECT_EQ(expected_contents, contents);
 }
 
+TEST_F(LoggerTest, ConcurrentWrites) {
+  const size_t kThreadCount = 4;
+  const size_t kLineCount = 1000;
+
+  // The messages should be buffered while the logger is running.
+  ASSERT_TRUE(logger_.writer_is_running_);
+
+  // Write from a few threads at once.
+  ScopedVector<base::Thread> threads;
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    threads.push_back(new base::Thread(base::StringPrintf("Writer %d", i)));
+    ASSERT_TRUE(threads.back()->Start());
+    threads.back()->message_loop()->PostTask(
+        FROM_HERE,
+        base::Bind(&WriteNumberedLines, &logger_, i, kLineCount));
+  }
+  for (size_t i = 0; i < kThreadCount; ++i)
+    threads[i]->Stop();
+
+  // Stop the logger, this flushes the pending output.
+  ASSERT_TRUE(logger_.Stop());
+  ASSERT_NO_FATAL_FAILURE(WaitForLoggerToFinish());
+  ASSERT_FALSE(logger_.writer_is_running_);
+  log_file_.reset(NULL);
+
+  std::string contents;
+  ASSERT_TRUE(file_util::ReadFileToString(log_file_path_, &contents));
+
+  // Every line should be there, in order for a given thread.
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    size_t position = 0;
+    for (size_t j = 0; j < kLineCount; ++j) {
+      std::string line(base::StringPrintf("Thread %d line %d\n", i, j));
+      size_t found = contents.find(line, position);
+      ASSERT_NE(std::string::npos, found);
+      position = found + line.size();
+    }
+  }
+}
+
 TEST_F(LoggerTest, RpcWrite) {
   // Connect to the logger over RPC.
   trace::client::ScopedRpcBinding rpc_binding;
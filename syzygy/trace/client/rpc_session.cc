@@ -28,6 +28,9 @@ RpcSession::RpcSession()
     : rpc_binding_(NULL),
       session_handle_(NULL),
       flags_(0),
+      exchange_ring_handle_(NULL),
+      exchange_ring_(NULL),
+      exchange_ring_event_(NULL),
       is_disabled_(false) {
 }
 
@@ -80,6 +83,93 @@ bool RpcSession::MapSegmentBuffer(TraceFileSegment* segment) {
   return true;
 }
 
+void RpcSession::CreateExchangeRing() {
+  DCHECK(IsTracing());
+
+  unsigned long ring_handle = 0;
+  unsigned long event_handle = 0;
+  bool succeeded = InvokeRpc(CallTraceClient_CreateExchangeRing,
+                             session_handle_,
+                             &ring_handle,
+                             &event_handle).succeeded();
+  if (!succeeded) {
+    // Older services don't support the ring, which is fine.
+    VLOG(1) << "Exchanging buffers via RPC.";
+    return;
+  }
+
+  HANDLE mapping = reinterpret_cast<HANDLE>(ring_handle);
+  HANDLE event = reinterpret_cast<HANDLE>(event_handle);
+  void* view = ::MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0,
+                               sizeof(BufferExchangeRing));
+  if (view == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to map buffer exchange ring: "
+               << com::LogWe(error) << ".";
+    ignore_result(::CloseHandle(mapping));
+    ignore_result(::CloseHandle(event));
+    return;
+  }
+
+  base::AutoLock scoped_lock(exchange_ring_lock_);
+  exchange_ring_handle_ = mapping;
+  exchange_ring_ = reinterpret_cast<BufferExchangeRing*>(view);
+  exchange_ring_event_ = event;
+}
+
+bool RpcSession::CommitToExchangeRing(TraceFileSegment* segment,
+                                      bool* exchanged) {
+  DCHECK(segment != NULL);
+
+  BufferExchangeEntry entry = {};
+  entry.shared_memory_handle = segment->buffer_info.shared_memory_handle;
+  entry.mapping_size = segment->buffer_info.mapping_size;
+  entry.buffer_offset = segment->buffer_info.buffer_offset;
+  entry.buffer_size = segment->buffer_info.buffer_size;
+
+  {
+    base::AutoLock scoped_lock(exchange_ring_lock_);
+
+    if (exchange_ring_ == NULL || !exchange_ring_->committed.Push(entry))
+      return false;
+
+    if (exchanged != NULL) {
+      *exchanged = exchange_ring_->available.Pop(&entry);
+      if (*exchanged) {
+        segment->buffer_info.shared_memory_handle =
+            entry.shared_memory_handle;
+        segment->buffer_info.mapping_size = entry.mapping_size;
+        segment->buffer_info.buffer_offset = entry.buffer_offset;
+        segment->buffer_info.buffer_size = entry.buffer_size;
+      }
+    }
+
+    // The service drains the committed queue and tops up the available one
+    // when signaled.
+    ignore_result(::SetEvent(exchange_ring_event_));
+  }
+
+  return true;
+}
+
+void RpcSession::FreeExchangeRing() {
+  base::AutoLock scoped_lock(exchange_ring_lock_);
+
+  if (exchange_ring_ == NULL)
+    return;
+
+  if (::UnmapViewOfFile(exchange_ring_) == 0) {
+    DWORD error = ::GetLastError();
+    LOG(WARNING) << "Failed to unmap exchange ring: " << com::LogWe(error);
+  }
+  ignore_result(::CloseHandle(exchange_ring_handle_));
+  ignore_result(::CloseHandle(exchange_ring_event_));
+
+  exchange_ring_handle_ = NULL;
+  exchange_ring_ = NULL;
+  exchange_ring_event_ = NULL;
+}
+
 bool RpcSession::CreateSession(TraceFileSegment* segment) {
   DCHECK(session_handle_ == NULL);
   DCHECK(rpc_binding_ == NULL);
@@ -118,6 +208,8 @@ bool RpcSession::CreateSession(TraceFileSegment* segment) {
     return false;
   }
 
+  CreateExchangeRing();
+
   return true;
 }
 
@@ -162,6 +254,13 @@ bool RpcSession::ExchangeBuffer(TraceFileSegment* segment) {
   DCHECK(IsTracing());
   DCHECK(segment != NULL);
 
+  // Try the exchange ring first. If the buffer makes it there but the ring
+  // has no fresh buffer to offer, we request one via RPC, which takes care of
+  // back-pressure.
+  bool exchanged = false;
+  if (CommitToExchangeRing(segment, &exchanged))
+    return exchanged ? MapSegmentBuffer(segment) : AllocateBuffer(segment);
+
   bool succeeded = InvokeRpc(CallTraceClient_ExchangeBuffer,
                              session_handle_,
                              &segment->buffer_info).succeeded();
@@ -173,6 +272,9 @@ bool RpcSession::ReturnBuffer(TraceFileSegment* segment) {
   DCHECK(IsTracing());
   DCHECK(segment != NULL);
 
+  if (CommitToExchangeRing(segment, NULL))
+    return true;
+
   return InvokeRpc(CallTraceClient_ReturnBuffer,
                    session_handle_,
                    &segment->buffer_info).succeeded();
@@ -181,6 +283,9 @@ bool RpcSession::ReturnBuffer(TraceFileSegment* segment) {
 bool RpcSession::CloseSession() {
   DCHECK(IsTracing());
 
+  // The service stops servicing the ring as the session closes.
+  FreeExchangeRing();
+
   bool succeeded = InvokeRpc(CallTraceClient_CloseSession,
                              &session_handle_).succeeded();
 
@@ -191,6 +296,8 @@ bool RpcSession::CloseSession() {
 }
 
 void RpcSession::FreeSharedMemory() {
+  FreeExchangeRing();
+
   base::AutoLock scoped_lock_(shared_memory_lock_);
 
   if (shared_memory_handles_.empty())
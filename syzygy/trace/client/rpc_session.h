@@ -22,6 +22,7 @@
 #include "base/logging.h"
 #include "base/synchronization/lock.h"
 #include "syzygy/trace/client/client_utils.h"
+#include "syzygy/trace/protocol/buffer_exchange_ring.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 
 namespace trace {
@@ -75,6 +76,23 @@ class RpcSession {
   // Map a tracefile segment buffer into local memory.
   bool MapSegmentBuffer(TraceFileSegment* segment);
 
+  // Sets up the buffer exchange ring with the call trace service. This is
+  // best effort: without a ring, buffers are exchanged via RPC.
+  void CreateExchangeRing();
+
+  // Commits the buffer of @p segment to the exchange ring, optionally picking
+  // up a fresh buffer from it.
+  // @param segment the segment whose buffer is to be committed.
+  // @param exchanged if non-NULL, a fresh buffer is picked up if the ring has
+  //     one to offer. Receives true iff one was, in which case it replaces the
+  //     buffer info of @p segment.
+  // @returns true iff the buffer was committed. Otherwise, it's up to the
+  //     caller to return it via RPC.
+  bool CommitToExchangeRing(TraceFileSegment* segment, bool* exchanged);
+
+  // Releases the exchange ring.
+  void FreeExchangeRing();
+
   // The call trace RPC binding.
   handle_t rpc_binding_;
 
@@ -95,6 +113,15 @@ class RpcSession {
   base::Lock shared_memory_lock_;
   SharedMemoryHandleMap shared_memory_handles_;
 
+  // The buffer exchange ring shared with the call trace service, if any, and
+  // the event to signal after committing buffers to it. Any access to the
+  // ring must be serialized with the lock, which makes us the single
+  // producer and consumer the ring's queues require.
+  base::Lock exchange_ring_lock_;
+  HANDLE exchange_ring_handle_;  // Under exchange_ring_lock_.
+  BufferExchangeRing* exchange_ring_;  // Under exchange_ring_lock_.
+  HANDLE exchange_ring_event_;  // Under exchange_ring_lock_.
+
   // This becomes true if the client fails to attach to a call trace service.
   // This is used to allow the application to run even if no call trace
   // service is available.
@@ -171,5 +171,90 @@ bool TscToFileTime(const ClockInfo& clock_info,
                          file_time);
 }
 
+uint64 GetQpcFrequency() {
+  LargeInteger frequency = {};
+  if (!::QueryPerformanceFrequency(&frequency.li))
+    return 0;
+  return frequency.ui64;
+}
+
+uint64 GetQpc() {
+  LargeInteger counter = {};
+  ::QueryPerformanceCounter(&counter.li);
+  return counter.ui64;
+}
+
+void GetClockSample(ClockSample* sample) {
+  DCHECK(sample != NULL);
+
+  ::GetSystemTimeAsFileTime(&sample->file_time);
+  uint64 tsc_before = GetTsc();
+  sample->qpc = GetQpc();
+  uint64 tsc_after = GetTsc();
+  sample->tsc = tsc_before + (tsc_after - tsc_before) / 2;
+}
+
+ClockTimeline::ClockTimeline() {
+  Reset();
+}
+
+void ClockTimeline::Reset() {
+  last_tsc_ = 0;
+  last_time_ = 0;
+  previous_tsc_ = 0;
+  previous_time_ = 0;
+  num_samples_ = 0;
+}
+
+bool ClockTimeline::AddSample(const ClockSample& reference,
+                              const ClockSample& sample,
+                              uint64 qpc_frequency) {
+  if (qpc_frequency == 0 || sample.qpc < reference.qpc)
+    return false;
+
+  TimerInfo qpc_info = { qpc_frequency, 1 };
+  FILETIME file_time = {};
+  if (!TimerToFileTime(reference.file_time, qpc_info, reference.qpc,
+                       sample.qpc, &file_time)) {
+    return false;
+  }
+  uint64 time = (static_cast<uint64>(file_time.dwHighDateTime) << 32) |
+      file_time.dwLowDateTime;
+
+  // Samples must move forward on both timers to yield a TSC rate.
+  if (num_samples_ > 0 && (sample.tsc <= last_tsc_ || time <= last_time_))
+    return false;
+
+  previous_tsc_ = last_tsc_;
+  previous_time_ = last_time_;
+  last_tsc_ = sample.tsc;
+  last_time_ = time;
+  ++num_samples_;
+
+  return true;
+}
+
+bool ClockTimeline::TscToFileTime(const TimerInfo& tsc_info,
+                                  uint64 tsc,
+                                  FILETIME* file_time) const {
+  DCHECK(file_time != NULL);
+
+  if (num_samples_ == 0)
+    return false;
+
+  TimerInfo info = tsc_info;
+  if (num_samples_ > 1) {
+    // The elapsed times are in 100ns intervals.
+    info.frequency = static_cast<uint64>(
+        1.0e7 * (last_tsc_ - previous_tsc_) / (last_time_ - previous_time_));
+    info.resolution = 1;
+  }
+
+  FILETIME last_file_time = {};
+  last_file_time.dwLowDateTime = last_time_ & 0xFFFFFFFF;
+  last_file_time.dwHighDateTime = last_time_ >> 32;
+  return TimerToFileTime(last_file_time, info, last_tsc_, tsc, file_time);
+}
+
 }  // namespace common
 }  // namespace trace
@@ -104,6 +104,76 @@ bool TscToFileTime(const ClockInfo& clock_info,
                    uint64 tsc,
                    FILETIME* file_time);
 
+// A sample of the system clock and the high resolution timers, taken as
+// close together as possible. The call trace service periodically writes
+// these to all sessions, which lets the parser map the TSC values of the
+// individual processes onto a single high resolution timeline.
+// NOTE: This is meant to be POD so that it can be written directly as is to and
+//     from disk.
+struct ClockSample {
+  FILETIME file_time;
+  uint64 qpc;
+  uint64 tsc;
+};
+COMPILE_ASSERT_IS_POD(ClockSample);
+
+// @returns the frequency of the performance counter, in counts per second, or
+//     zero if there is no performance counter on this system.
+uint64 GetQpcFrequency();
+
+// @returns the current value of the performance counter.
+uint64 GetQpc();
+
+// Takes a clock sample. The TSC value is the average of reads on either side
+// of the performance counter read.
+// @param sample The sample to be populated.
+void GetClockSample(ClockSample* sample);
+
+// Maps TSC values to file times using the clock samples taken by the call
+// trace service. All samples are expressed relative to a common reference
+// sample, so that the performance counter, rather than the coarse system
+// clock, drives the timeline. The rate of the TSC is derived from the two
+// most recent samples, and TSC values are extrapolated from the most recent.
+class ClockTimeline {
+ public:
+  ClockTimeline();
+
+  // Forgets all samples.
+  void Reset();
+
+  // Adds a sample to the timeline.
+  // @param reference The reference sample the timeline is anchored to.
+  // @param sample The sample to add.
+  // @param qpc_frequency The frequency of the performance counter.
+  // @returns true on success, false if the sample is unusable.
+  bool AddSample(const ClockSample& reference,
+                 const ClockSample& sample,
+                 uint64 qpc_frequency);
+
+  // Converts a TSC value to a file time.
+  // @param tsc_info Information about the TSC, used to derive its rate until
+  //     the timeline has two samples.
+  // @param tsc The value of the TSC counter.
+  // @param file_time The file time to be populated.
+  // @returns true on success, false if the timeline has no samples or the TSC
+  //     rate is unknown.
+  bool TscToFileTime(const TimerInfo& tsc_info,
+                     uint64 tsc,
+                     FILETIME* file_time) const;
+
+  // @returns the number of samples added since the last reset.
+  size_t num_samples() const { return num_samples_; }
+
+ private:
+  // The TSC values of the two most recent samples, and their times on the
+  // timeline, in 100ns intervals.
+  uint64 last_tsc_;
+  uint64 last_time_;
+  uint64 previous_tsc_;
+  uint64 previous_time_;
+  size_t num_samples_;
+};
+
 }  // namespace common
 }  // namespace trace
 
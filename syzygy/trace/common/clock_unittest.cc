@@ -174,5 +174,89 @@ TEST(TscToFileTimeTest, WorksAsExpected) {
   EXPECT_EQ(0, ft.dwHighDateTime);
 }
 
+TEST(GetQpcTest, WorksAsExpected) {
+  EXPECT_LT(0u, GetQpcFrequency());
+
+  uint64 qpc1 = GetQpc();
+  ::Sleep(10);
+  uint64 qpc2 = GetQpc();
+  EXPECT_LT(qpc1, qpc2);
+}
+
+TEST(GetClockSampleTest, WorksAsExpected) {
+  ClockSample sample1 = {};
+  ClockSample sample2 = {};
+  GetClockSample(&sample1);
+  ::Sleep(10);
+  GetClockSample(&sample2);
+
+  EXPECT_LT(sample1.qpc, sample2.qpc);
+  EXPECT_LT(sample1.tsc, sample2.tsc);
+  EXPECT_GE(0, ::CompareFileTime(&sample1.file_time, &sample2.file_time));
+}
+
+TEST(ClockTimelineTest, FailsWithoutSamples) {
+  ClockTimeline timeline;
+  TimerInfo tsc_info = { 1000, 1 };
+  FILETIME ft = {};
+  EXPECT_EQ(0u, timeline.num_samples());
+  EXPECT_FALSE(timeline.TscToFileTime(tsc_info, 100, &ft));
+}
+
+TEST(ClockTimelineTest, RejectsInvalidSamples) {
+  ClockTimeline timeline;
+  ClockSample reference = { {}, 1000, 5000 };
+  ClockSample sample = { {}, 500, 6000 };
+
+  EXPECT_FALSE(timeline.AddSample(reference, reference, 0));
+  EXPECT_FALSE(timeline.AddSample(reference, sample, 1000));
+  EXPECT_EQ(0u, timeline.num_samples());
+
+  // Samples must move forward.
+  EXPECT_TRUE(timeline.AddSample(reference, reference, 1000));
+  EXPECT_FALSE(timeline.AddSample(reference, reference, 1000));
+  EXPECT_EQ(1u, timeline.num_samples());
+}
+
+TEST(ClockTimelineTest, UsesTscInfoWithOneSample) {
+  ClockTimeline timeline;
+  ClockSample reference = { {}, 1000, 5000 };
+  ASSERT_TRUE(timeline.AddSample(reference, reference, 1000));
+
+  FILETIME ft = {};
+  TimerInfo invalid_info = {};
+  EXPECT_FALSE(timeline.TscToFileTime(invalid_info, 5100, &ft));
+
+  // 100 cycles at 1000 Hz is 100 ms, or 1e6 100ns intervals.
+  TimerInfo tsc_info = { 1000, 1 };
+  EXPECT_TRUE(timeline.TscToFileTime(tsc_info, 5100, &ft));
+  EXPECT_EQ(1e6, ft.dwLowDateTime);
+  EXPECT_EQ(0, ft.dwHighDateTime);
+}
+
+TEST(ClockTimelineTest, DerivesTscRateFromSamples) {
+  ClockTimeline timeline;
+  ClockSample reference = { {}, 1000, 5000 };
+  ASSERT_TRUE(timeline.AddSample(reference, reference, 1000));
+
+  // One second elapses on the performance counter, during which the TSC
+  // counts 2000 cycles.
+  ClockSample sample = { {}, 2000, 7000 };
+  ASSERT_TRUE(timeline.AddSample(reference, sample, 1000));
+  EXPECT_EQ(2u, timeline.num_samples());
+
+  // The nominal TSC rate is ignored in favor of the derived one. 200 cycles
+  // past the last sample is 100 ms past one second.
+  TimerInfo tsc_info = { 1000, 1 };
+  FILETIME ft = {};
+  EXPECT_TRUE(timeline.TscToFileTime(tsc_info, 7200, &ft));
+  EXPECT_EQ(11e6, ft.dwLowDateTime);
+  EXPECT_EQ(0, ft.dwHighDateTime);
+
+  timeline.Reset();
+  EXPECT_EQ(0u, timeline.num_samples());
+  EXPECT_FALSE(timeline.TscToFileTime(tsc_info, 7200, &ft));
+}
+
 }  // namespace common
 }  // namespace trace
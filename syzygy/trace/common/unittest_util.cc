@@ -105,16 +105,17 @@ void CallTraceService::SetEnvironment() {
   ASSERT_TRUE(env->SetVar(::kSyzygyRpcInstanceIdEnvVar, env_var));
 }
 
-void WriteRecord(uint64 timestamp,
+void BuildRecord(uint64 timestamp,
                  uint16 record_type,
                  const void* data,
                  size_t length,
-                 trace::service::TraceFileWriter* writer) {
+                 size_t block_size,
+                 std::vector<uint8>* buffer) {
   ASSERT_TRUE(data != NULL);
-  ASSERT_TRUE(writer != NULL);
+  ASSERT_TRUE(buffer != NULL);
 
-  std::vector<uint8> buffer;
-  ::common::VectorBufferWriter buffer_writer(&buffer);
+  buffer->clear();
+  ::common::VectorBufferWriter buffer_writer(buffer);
 
   RecordPrefix record = {};
   record.timestamp = timestamp;
@@ -136,7 +137,19 @@ void WriteRecord(uint64 timestamp,
   ASSERT_TRUE(buffer_writer.Write(
       length, reinterpret_cast<const void*>(data)));
 
-  buffer.resize(::common::AlignUp(buffer.size(), writer->block_size()));
+  buffer->resize(::common::AlignUp(buffer->size(), block_size));
+}
+
+void WriteRecord(uint64 timestamp,
+                 uint16 record_type,
+                 const void* data,
+                 size_t length,
+                 trace::service::TraceFileWriter* writer) {
+  ASSERT_TRUE(writer != NULL);
+
+  std::vector<uint8> buffer;
+  ASSERT_NO_FATAL_FAILURE(BuildRecord(timestamp, record_type, data, length,
+                                      writer->block_size(), &buffer));
   ASSERT_TRUE(writer->WriteRecord(buffer.data(), buffer.size()));
 }
 
@@ -17,6 +17,8 @@
 #ifndef SYZYGY_TRACE_COMMON_UNITTEST_UTIL_H_
 #define SYZYGY_TRACE_COMMON_UNITTEST_UTIL_H_
 
+#include <vector>
+
 #include "base/process_util.h"
 #include "base/string_piece.h"
 #include "base/files/file_path.h"
@@ -51,6 +53,21 @@ class CallTraceService {
   base::ProcessHandle service_process_;
 };
 
+// Given a raw record, wraps it with a RecordPrefix/TraceFileSegmentHeader/
+// RecordPrefix header, as a client would lay it out in a buffer.
+// @param timestamp The timestamp to use for the record.
+// @param record_type The type of the record.
+// @param data The raw data.
+// @param length The length of the raw data.
+// @param block_size The block size to which the buffer is aligned.
+// @param buffer Receives the wrapped record.
+void BuildRecord(uint64 timestamp,
+                 uint16 record_type,
+                 const void* data,
+                 size_t length,
+                 size_t block_size,
+                 std::vector<uint8>* buffer);
+
 // Given a raw record, wraps it with a RecordPrefix/TraceFileSegmentHeader/
 // RecordPrefix header before pushing it to the provided TraceFileWriter.
 // @param timestamp The timestamp to use for the record.
@@ -0,0 +1,416 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/etw_control/cold_start_app.h"
+
+#include <windows.h>  // NOLINT
+
+#include "base/file_util.h"
+#include "base/logging.h"
+#include "base/process_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/win/event_trace_controller.h"
+#include "base/win/scoped_handle.h"
+#include "sawbuck/common/com_utils.h"
+#include "sawbuck/log_lib/kernel_log_consumer.h"
+
+namespace trace {
+namespace etw_control {
+
+namespace {
+
+using base::win::EtwTraceController;
+using base::win::EtwTraceProperties;
+
+const char kUsageFormatStr[] =
+    "Usage: %ls [options] -- PROGRAM [ARGUMENTS]\n"
+    "\n"
+    "  A tool that launches a program repeatedly from a cold cache, and\n"
+    "  reports the hard page faults incurred by each of its modules and the\n"
+    "  time it takes to load them. The launches are recorded with the NT\n"
+    "  Kernel Logger, so this must run elevated, and no other kernel logging\n"
+    "  session may be running.\n"
+    "\n"
+    "Options:\n"
+    "\n"
+    "  --iterations=POSINT   The number of times to launch the program.\n"
+    "                        Defaults to 5.\n"
+    "  --no-flush-standby-list\n"
+    "                        Does not flush the standby list before each\n"
+    "                        launch, which measures warm starts instead.\n"
+    "  --output-file=PATH    The JSON file to write the results to. Defaults\n"
+    "                        to the standard output.\n"
+    "  --pretty-print        Pretty prints the JSON output.\n"
+    "  --startup-ms=POSINT   The time given to each launch, in milliseconds.\n"
+    "                        The program is killed once this elapses, if it\n"
+    "                        is still running. Defaults to 10000.\n"
+    "\n";
+
+// The kernel events that the recording relies on.
+const ULONG kKernelFlags = EVENT_TRACE_FLAG_PROCESS |
+    EVENT_TRACE_FLAG_IMAGE_LOAD |
+    EVENT_TRACE_FLAG_MEMORY_PAGE_FAULTS;
+
+// The system information class and command that purge the standby list, as
+// used by NtSetSystemInformation. These aren't in the SDK headers.
+const int kSystemMemoryListInformation = 80;
+const int kMemoryPurgeStandbyList = 4;
+
+typedef LONG (NTAPI* NtSetSystemInformationFunc)(int information_class,
+                                                 void* information,
+                                                 ULONG information_length);
+
+// Enables a privilege of the current process.
+bool EnablePrivilege(const wchar_t* privilege_name) {
+  DCHECK(privilege_name != NULL);
+
+  HANDLE token = NULL;
+  if (!::OpenProcessToken(::GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES,
+                          &token)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "OpenProcessToken failed: " << com::LogWe(error) << ".";
+    return false;
+  }
+  base::win::ScopedHandle scoped_token(token);
+
+  TOKEN_PRIVILEGES privileges = {};
+  privileges.PrivilegeCount = 1;
+  privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+  if (!::LookupPrivilegeValue(NULL, privilege_name,
+                              &privileges.Privileges[0].Luid)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "LookupPrivilegeValue failed: " << com::LogWe(error) << ".";
+    return false;
+  }
+
+  // AdjustTokenPrivileges succeeds even if the privilege isn't held, which
+  // is only reported through the last error.
+  if (!::AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL) ||
+      ::GetLastError() != ERROR_SUCCESS) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to enable " << privilege_name << ": "
+               << com::LogWe(error) << ".";
+    return false;
+  }
+
+  return true;
+}
+
+// Flushes the standby list, so that the pages of files that are no longer in
+// use have to be read from disk again.
+bool FlushStandbyList() {
+  if (!EnablePrivilege(SE_PROF_SINGLE_PROCESS_NAME))
+    return false;
+
+  HMODULE ntdll = ::GetModuleHandle(L"ntdll.dll");
+  DCHECK(ntdll != NULL);
+  NtSetSystemInformationFunc nt_set_system_information =
+      reinterpret_cast<NtSetSystemInformationFunc>(
+          ::GetProcAddress(ntdll, "NtSetSystemInformation"));
+  if (nt_set_system_information == NULL) {
+    LOG(ERROR) << "Unable to find NtSetSystemInformation.";
+    return false;
+  }
+
+  int command = kMemoryPurgeStandbyList;
+  LONG status = nt_set_system_information(kSystemMemoryListInformation,
+                                          &command,
+                                          sizeof(command));
+  if (status < 0) {
+    LOG(ERROR) << "Unable to flush the standby list, status 0x"
+               << std::hex << status << std::dec << ".";
+    return false;
+  }
+
+  return true;
+}
+
+// Starts the NT Kernel Logger session, writing to @p log_file.
+bool StartKernelSession(const base::FilePath& log_file) {
+  EtwTraceProperties props;
+  EVENT_TRACE_PROPERTIES* p = props.get();
+
+  SYSTEM_INFO sysinfo = { 0 };
+  ::GetSystemInfo(&sysinfo);
+
+  // Use the CPU cycle counter, with the largest buffers possible, as the
+  // page faults are plentiful.
+  p->Wnode.ClientContext = 3;
+  p->Wnode.Guid = kSystemTraceControlGuid;
+  p->BufferSize = 1024;
+  p->FlushTimer = 0;
+  p->EnableFlags = kKernelFlags;
+  p->LogFileMode = EVENT_TRACE_FILE_MODE_NONE;
+  p->MinimumBuffers = 2 * sysinfo.dwNumberOfProcessors;
+  p->MaximumBuffers = 4 * sysinfo.dwNumberOfProcessors;
+  props.SetLoggerFileName(log_file.value().c_str());
+
+  TRACEHANDLE session_handle = NULL;
+  HRESULT hr = EtwTraceController::Start(KERNEL_LOGGER_NAMEW,
+                                         &props,
+                                         &session_handle);
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failed to start the kernel session: "
+               << com::LogHr(hr) << ".";
+    return false;
+  }
+
+  return true;
+}
+
+// Flushes and stops the NT Kernel Logger session.
+bool StopKernelSession() {
+  EtwTraceProperties props;
+  HRESULT hr = EtwTraceController::Flush(KERNEL_LOGGER_NAMEW, &props);
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failed to flush the kernel session: "
+               << com::LogHr(hr) << ".";
+    // Stop the session regardless, so that it isn't left running.
+  }
+
+  HRESULT stop_hr = EtwTraceController::Stop(KERNEL_LOGGER_NAMEW, &props);
+  if (FAILED(stop_hr)) {
+    LOG(ERROR) << "Failed to stop the kernel session: "
+               << com::LogHr(stop_hr) << ".";
+    return false;
+  }
+
+  return SUCCEEDED(hr);
+}
+
+// Launches @p command_line and gives it @p startup_time to run, killing it if
+// it is still running then.
+// @param process_id receives the ID of the launched process.
+bool LaunchAndWait(const CommandLine& command_line,
+                   const base::TimeDelta& startup_time,
+                   DWORD* process_id) {
+  DCHECK(process_id != NULL);
+
+  base::ProcessHandle process_handle = base::kNullProcessHandle;
+  base::LaunchOptions options;
+  if (!base::LaunchProcess(command_line, options, &process_handle)) {
+    LOG(ERROR)
+        << "Failed to launch '" << command_line.GetProgram().value() << "'.";
+    return false;
+  }
+  *process_id = base::GetProcId(process_handle);
+
+  DWORD wait = ::WaitForSingleObject(
+      process_handle, static_cast<DWORD>(startup_time.InMilliseconds()));
+  if (wait == WAIT_TIMEOUT) {
+    LOG(INFO) << "Killing process " << *process_id << ".";
+    base::KillProcess(process_handle, 1, true);
+  }
+  base::CloseProcessHandle(process_handle);
+
+  return wait == WAIT_OBJECT_0 || wait == WAIT_TIMEOUT;
+}
+
+// Parses a strictly positive integer switch, defaulting to @p default_value
+// when absent.
+bool ParsePositiveSwitch(const CommandLine* command_line,
+                         const char* switch_name,
+                         size_t default_value,
+                         size_t* value) {
+  DCHECK(command_line != NULL);
+  DCHECK(switch_name != NULL);
+  DCHECK(value != NULL);
+
+  *value = default_value;
+  if (!command_line->HasSwitch(switch_name))
+    return true;
+
+  std::string value_str = command_line->GetSwitchValueASCII(switch_name);
+  if (!base::StringToSizeT(value_str, value) || *value == 0) {
+    LOG(ERROR) << "Invalid value for --" << switch_name << ": "
+               << value_str << ".";
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace
+
+const char ColdStartApp::kIterations[] = "iterations";
+const char ColdStartApp::kNoFlushStandbyList[] = "no-flush-standby-list";
+const char ColdStartApp::kOutputFile[] = "output-file";
+const char ColdStartApp::kPrettyPrint[] = "pretty-print";
+const char ColdStartApp::kStartupMs[] = "startup-ms";
+
+const size_t ColdStartApp::kDefaultIterations = 5;
+const size_t ColdStartApp::kDefaultStartupMs = 10000;
+
+ColdStartApp::ColdStartApp()
+    : common::AppImplBase("ColdStart"),
+      iterations_(kDefaultIterations),
+      startup_time_(base::TimeDelta::FromMilliseconds(kDefaultStartupMs)),
+      flush_standby_list_(true),
+      pretty_print_(false) {
+}
+
+bool ColdStartApp::ParseCommandLine(const CommandLine* command_line) {
+  DCHECK(command_line != NULL);
+
+  if (command_line->HasSwitch("help"))
+    return Usage(command_line->GetProgram(), "");
+
+  size_t startup_ms = 0;
+  if (!ParsePositiveSwitch(command_line, kIterations, kDefaultIterations,
+                           &iterations_) ||
+      !ParsePositiveSwitch(command_line, kStartupMs, kDefaultStartupMs,
+                           &startup_ms)) {
+    return Usage(command_line->GetProgram(), "");
+  }
+  startup_time_ = base::TimeDelta::FromMilliseconds(startup_ms);
+
+  flush_standby_list_ = !command_line->HasSwitch(kNoFlushStandbyList);
+  output_file_ = command_line->GetSwitchValuePath(kOutputFile);
+  pretty_print_ = command_line->HasSwitch(kPrettyPrint);
+
+  // The program to launch and its arguments follow the switches.
+  const CommandLine::StringVector& args = command_line->GetArgs();
+  if (args.empty()) {
+    return Usage(command_line->GetProgram(),
+                 "You must specify the program to launch.");
+  }
+  target_command_line_.reset(new CommandLine(base::FilePath(args[0])));
+  for (size_t i = 1; i < args.size(); ++i)
+    target_command_line_->AppendArgNative(args[i]);
+
+  return true;
+}
+
+int ColdStartApp::Run() {
+  DCHECK(target_command_line_.get() != NULL);
+
+  base::ScopedTempDir temp_dir;
+  if (!temp_dir.CreateUniqueTempDir()) {
+    LOG(ERROR) << "Unable to create a temporary directory.";
+    return 1;
+  }
+  base::FilePath log_file = temp_dir.path().Append(L"kernel.etl");
+
+  ColdStartSummary summary;
+  for (size_t i = 0; i < iterations_; ++i) {
+    LOG(INFO) << "Running iteration " << (i + 1) << " of " << iterations_
+              << ".";
+    ColdStartRun run;
+    if (!RunIteration(log_file, &run))
+      return 1;
+    summary.AddRun(run);
+  }
+
+  if (!OutputSummary(summary))
+    return 1;
+
+  return 0;
+}
+
+bool ColdStartApp::Usage(const base::FilePath& program,
+                         const base::StringPiece& message) {
+  if (!message.empty()) {
+    ::fwrite(message.data(), 1, message.length(), out());
+    ::fprintf(out(), "\n\n");
+  }
+
+  ::fprintf(out(), kUsageFormatStr, program.BaseName().value().c_str());
+
+  return false;
+}
+
+bool ColdStartApp::RunIteration(const base::FilePath& log_file,
+                                ColdStartRun* run) {
+  DCHECK(run != NULL);
+
+  if (flush_standby_list_ && !FlushStandbyList())
+    return false;
+
+  if (!StartKernelSession(log_file))
+    return false;
+
+  DWORD process_id = 0;
+  bool launched = LaunchAndWait(*target_command_line_, startup_time_,
+                                &process_id);
+  if (!StopKernelSession() || !launched)
+    return false;
+
+  ColdStartRecorder recorder(process_id, run);
+  KernelLogConsumer consumer;
+  consumer.set_module_event_sink(&recorder);
+  consumer.set_page_fault_event_sink(&recorder);
+  consumer.set_process_event_sink(&recorder);
+  consumer.set_infer_bitness_from_log(true);
+
+  HRESULT hr = consumer.OpenFileSession(log_file.value().c_str());
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failed to open " << log_file.value() << ": "
+               << com::LogHr(hr) << ".";
+    return false;
+  }
+
+  hr = consumer.Consume();
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failed to consume " << log_file.value() << ": "
+               << com::LogHr(hr) << ".";
+    return false;
+  }
+
+  if (run->process_count == 0) {
+    LOG(ERROR) << "The launched process is missing from the kernel log.";
+    return false;
+  }
+
+  LOG(INFO) << "Recorded " << run->hard_faults << " hard faults in "
+            << run->modules.size() << " modules.";
+
+  return true;
+}
+
+bool ColdStartApp::OutputSummary(const ColdStartSummary& summary) {
+  file_util::ScopedFILE output_file;
+  FILE* output = out();
+  if (!output_file_.empty()) {
+    output_file.reset(file_util::OpenFile(output_file_, "w"));
+    output = output_file.get();
+
+    if (output == NULL) {
+      LOG(ERROR) << "Failed to open " << output_file_.value()
+                 << " for writing.";
+      return false;
+    }
+  }
+
+  core::JSONFileWriter json_file(output, pretty_print_);
+  if (!json_file.OpenDict() ||
+      !json_file.OutputKey("command_line") ||
+      !json_file.OutputString(
+          target_command_line_->GetCommandLineString()) ||
+      !json_file.OutputKey("iterations") ||
+      !json_file.OutputInteger(iterations_) ||
+      !json_file.OutputKey("flush_standby_list") ||
+      !json_file.OutputBoolean(flush_standby_list_) ||
+      !summary.OutputJSON(&json_file) ||
+      !json_file.CloseDict()) {
+    LOG(ERROR) << "Unable to write the results.";
+    return false;
+  }
+  DCHECK(json_file.Finished());
+
+  return true;
+}
+
+}  // namespace etw_control
+}  // namespace trace
@@ -0,0 +1,98 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the ColdStartApp, a benchmark runner that launches a program
+// repeatedly from a cold cache, and reports the hard page faults incurred by
+// each of its modules, and the time it takes to load them. The runs are
+// recorded with the NT Kernel Logger, so this needs to run elevated.
+
+#ifndef SYZYGY_TRACE_ETW_CONTROL_COLD_START_APP_H_
+#define SYZYGY_TRACE_ETW_CONTROL_COLD_START_APP_H_
+
+#include "base/command_line.h"
+#include "base/time.h"
+#include "base/files/file_path.h"
+#include "base/memory/scoped_ptr.h"
+#include "syzygy/common/application.h"
+#include "syzygy/trace/etw_control/cold_start_recorder.h"
+
+namespace trace {
+namespace etw_control {
+
+// The application class that runs the cold-start benchmark. Each iteration
+// flushes the standby list, so that the images of the program must be read
+// from disk again, then records the launch of the program in a kernel log,
+// and finally parses the log into a ColdStartRun.
+class ColdStartApp : public common::AppImplBase {
+ public:
+  ColdStartApp();
+
+  // @name Implementation of the AppImplBase interface.
+  // @{
+  bool ParseCommandLine(const CommandLine* command_line);
+  int Run();
+  // @}
+
+  // @name Command-line switches.
+  // @{
+  static const char kIterations[];
+  static const char kNoFlushStandbyList[];
+  static const char kOutputFile[];
+  static const char kPrettyPrint[];
+  static const char kStartupMs[];
+  // @}
+
+  // @name Default command-line values.
+  // @{
+  static const size_t kDefaultIterations;
+  static const size_t kDefaultStartupMs;
+  // @}
+
+ protected:
+  // Prints the usage statement.
+  // @param program the path to the executable.
+  // @param message an optional message that will precede the usage statement.
+  // @returns false.
+  bool Usage(const base::FilePath& program, const base::StringPiece& message);
+
+  // Runs a single iteration of the benchmark.
+  // @param log_file the kernel log to record the launch to.
+  // @param run receives the outcome of the iteration.
+  // @returns true on success, false otherwise.
+  bool RunIteration(const base::FilePath& log_file, ColdStartRun* run);
+
+  // Writes the summary of the runs to output_file_, or to the standard output
+  // if none was specified.
+  // @param summary the runs to output.
+  // @returns true on success, false otherwise.
+  bool OutputSummary(const ColdStartSummary& summary);
+
+  // @name Command-line parameters.
+  // @{
+  scoped_ptr<CommandLine> target_command_line_;
+  size_t iterations_;
+  base::TimeDelta startup_time_;
+  bool flush_standby_list_;
+  base::FilePath output_file_;
+  bool pretty_print_;
+  // @}
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ColdStartApp);
+};
+
+}  // namespace etw_control
+}  // namespace trace
+
+#endif  // SYZYGY_TRACE_ETW_CONTROL_COLD_START_APP_H_
@@ -0,0 +1,128 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/etw_control/cold_start_app.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/common/unittest_util.h"
+
+namespace trace {
+namespace etw_control {
+
+namespace {
+
+class TestColdStartApp : public ColdStartApp {
+ public:
+  using ColdStartApp::flush_standby_list_;
+  using ColdStartApp::iterations_;
+  using ColdStartApp::output_file_;
+  using ColdStartApp::pretty_print_;
+  using ColdStartApp::startup_time_;
+  using ColdStartApp::target_command_line_;
+};
+
+typedef common::Application<TestColdStartApp> TestApp;
+
+class ColdStartAppTest : public testing::ApplicationTestBase {
+ public:
+  typedef testing::ApplicationTestBase Super;
+
+  ColdStartAppTest()
+      : cmd_line_(base::FilePath(L"cold_start.exe")),
+        impl_(app_.implementation()) {
+  }
+
+  virtual void SetUp() OVERRIDE {
+    Super::SetUp();
+
+    // The tests generate (deliberate) usage messages that would otherwise
+    // clutter the unittest output.
+    DisableLogging();
+
+    app_.set_in(in());
+    app_.set_out(out());
+    app_.set_err(err());
+  }
+
+  CommandLine cmd_line_;
+  TestApp app_;
+  TestApp::Implementation& impl_;
+};
+
+}  // namespace
+
+TEST_F(ColdStartAppTest, GetHelp) {
+  cmd_line_.AppendSwitch("help");
+  ASSERT_FALSE(impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(ColdStartAppTest, ParseWithNoProgramFails) {
+  ASSERT_FALSE(impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(ColdStartAppTest, ParseMinimal) {
+  cmd_line_.AppendArg("foo.exe");
+
+  ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(ColdStartApp::kDefaultIterations, impl_.iterations_);
+  EXPECT_EQ(static_cast<int64>(ColdStartApp::kDefaultStartupMs),
+            impl_.startup_time_.InMilliseconds());
+  EXPECT_TRUE(impl_.flush_standby_list_);
+  EXPECT_TRUE(impl_.output_file_.empty());
+  EXPECT_FALSE(impl_.pretty_print_);
+  ASSERT_TRUE(impl_.target_command_line_.get() != NULL);
+  EXPECT_EQ(base::FilePath(L"foo.exe"),
+            impl_.target_command_line_->GetProgram());
+  EXPECT_TRUE(impl_.target_command_line_->GetArgs().empty());
+}
+
+TEST_F(ColdStartAppTest, ParseFull) {
+  base::FilePath output_file(L"cold_start.json");
+  cmd_line_.AppendSwitchASCII(ColdStartApp::kIterations, "3");
+  cmd_line_.AppendSwitchASCII(ColdStartApp::kStartupMs, "500");
+  cmd_line_.AppendSwitch(ColdStartApp::kNoFlushStandbyList);
+  cmd_line_.AppendSwitchPath(ColdStartApp::kOutputFile, output_file);
+  cmd_line_.AppendSwitch(ColdStartApp::kPrettyPrint);
+  cmd_line_.AppendArg("foo.exe");
+  cmd_line_.AppendArg("bar");
+  cmd_line_.AppendArg("baz");
+
+  ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(3u, impl_.iterations_);
+  EXPECT_EQ(500, impl_.startup_time_.InMilliseconds());
+  EXPECT_FALSE(impl_.flush_standby_list_);
+  EXPECT_EQ(output_file, impl_.output_file_);
+  EXPECT_TRUE(impl_.pretty_print_);
+  ASSERT_TRUE(impl_.target_command_line_.get() != NULL);
+  EXPECT_EQ(base::FilePath(L"foo.exe"),
+            impl_.target_command_line_->GetProgram());
+  ASSERT_EQ(2u, impl_.target_command_line_->GetArgs().size());
+  EXPECT_EQ(L"bar", impl_.target_command_line_->GetArgs()[0]);
+  EXPECT_EQ(L"baz", impl_.target_command_line_->GetArgs()[1]);
+}
+
+TEST_F(ColdStartAppTest, ParseInvalidIterationsFails) {
+  cmd_line_.AppendSwitchASCII(ColdStartApp::kIterations, "0");
+  cmd_line_.AppendArg("foo.exe");
+  EXPECT_FALSE(impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(ColdStartAppTest, ParseInvalidStartupMsFails) {
+  cmd_line_.AppendSwitchASCII(ColdStartApp::kStartupMs, "soon");
+  cmd_line_.AppendArg("foo.exe");
+  EXPECT_FALSE(impl_.ParseCommandLine(&cmd_line_));
+}
+
+}  // namespace etw_control
+}  // namespace trace
@@ -0,0 +1,357 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/etw_control/cold_start_recorder.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "base/string_util.h"
+
+namespace trace {
+namespace etw_control {
+
+namespace {
+
+// The summary statistics of a quantity over several runs.
+struct Statistics {
+  Statistics() : min(0), max(0), mean(0), median(0) {
+  }
+
+  double min;
+  double max;
+  double mean;
+  double median;
+};
+
+typedef std::vector<double> Values;
+
+// The per-run values of the summarized quantities of a module.
+struct ModuleValues {
+  Values hard_faults;
+  Values load_times;
+};
+typedef std::map<std::wstring, ModuleValues> ModuleValuesMap;
+
+// Summarizes @p values, which are sorted in the process.
+void ComputeStatistics(Values* values, Statistics* stats) {
+  DCHECK(values != NULL);
+  DCHECK(stats != NULL);
+
+  *stats = Statistics();
+  if (values->empty())
+    return;
+
+  std::sort(values->begin(), values->end());
+  stats->min = values->front();
+  stats->max = values->back();
+
+  double sum = 0;
+  for (size_t i = 0; i < values->size(); ++i)
+    sum += (*values)[i];
+  stats->mean = sum / values->size();
+
+  size_t middle = values->size() / 2;
+  if (values->size() % 2 == 1) {
+    stats->median = (*values)[middle];
+  } else {
+    stats->median = ((*values)[middle - 1] + (*values)[middle]) / 2;
+  }
+}
+
+bool OutputStatistics(const base::StringPiece& key,
+                      Values* values,
+                      core::JSONFileWriter* json_file) {
+  DCHECK(values != NULL);
+  DCHECK(json_file != NULL);
+
+  Statistics stats;
+  ComputeStatistics(values, &stats);
+
+  if (!json_file->OutputKey(key) ||
+      !json_file->OpenDict() ||
+      !json_file->OutputKey("min") ||
+      !json_file->OutputDouble(stats.min) ||
+      !json_file->OutputKey("max") ||
+      !json_file->OutputDouble(stats.max) ||
+      !json_file->OutputKey("mean") ||
+      !json_file->OutputDouble(stats.mean) ||
+      !json_file->OutputKey("median") ||
+      !json_file->OutputDouble(stats.median) ||
+      !json_file->CloseDict()) {
+    return false;
+  }
+
+  return true;
+}
+
+bool OutputRun(const ColdStartRun& run, core::JSONFileWriter* json_file) {
+  DCHECK(json_file != NULL);
+
+  if (!json_file->OpenDict() ||
+      !json_file->OutputKey("process_count") ||
+      !json_file->OutputInteger(run.process_count) ||
+      !json_file->OutputKey("hard_faults") ||
+      !json_file->OutputInteger(run.hard_faults) ||
+      !json_file->OutputKey("unattributed_hard_faults") ||
+      !json_file->OutputInteger(run.unattributed_hard_faults) ||
+      !json_file->OutputKey("modules") ||
+      !json_file->OpenList()) {
+    return false;
+  }
+
+  ColdStartRun::ModuleMap::const_iterator it = run.modules.begin();
+  for (; it != run.modules.end(); ++it) {
+    if (!json_file->OpenDict() ||
+        !json_file->OutputKey("path") ||
+        !json_file->OutputString(it->first) ||
+        !json_file->OutputKey("hard_faults") ||
+        !json_file->OutputInteger(it->second.hard_faults) ||
+        !json_file->OutputKey("load_time_ms") ||
+        !json_file->OutputDouble(it->second.load_time.InMillisecondsF()) ||
+        !json_file->CloseDict()) {
+      return false;
+    }
+  }
+
+  if (!json_file->CloseList() || !json_file->CloseDict())
+    return false;
+
+  return true;
+}
+
+}  // namespace
+
+ColdStartRecorder::ColdStartRecorder(DWORD process_id, ColdStartRun* run)
+    : process_id_(process_id), run_(run) {
+  DCHECK(run != NULL);
+}
+
+void ColdStartRecorder::OnModuleIsLoaded(DWORD process_id,
+                                         const base::Time& time,
+                                         const ModuleInformation& module_info) {
+  // These are issued for the modules already loaded when the session starts
+  // or stops. The former predate the launch, and the latter have already been
+  // seen loading, so they only matter if their load was somehow missed.
+  ProcessMap::iterator process_it = processes_.find(process_id);
+  if (process_it == processes_.end())
+    return;
+  if (process_it->second.find(module_info.base_address) !=
+          process_it->second.end()) {
+    return;
+  }
+
+  std::wstring path(StringToLowerASCII(module_info.image_file_name));
+  LoadedModule& loaded = process_it->second[module_info.base_address];
+  loaded.size = module_info.module_size;
+  loaded.module = run_->modules.insert(
+      std::make_pair(path, ColdStartModule())).first;
+}
+
+void ColdStartRecorder::OnModuleUnload(DWORD process_id,
+                                       const base::Time& time,
+                                       const ModuleInformation& module_info) {
+  ProcessMap::iterator process_it = processes_.find(process_id);
+  if (process_it == processes_.end())
+    return;
+  process_it->second.erase(module_info.base_address);
+}
+
+void ColdStartRecorder::OnModuleLoad(DWORD process_id,
+                                     const base::Time& time,
+                                     const ModuleInformation& module_info) {
+  ProcessMap::iterator process_it = processes_.find(process_id);
+  if (process_it == processes_.end())
+    return;
+
+  base::TimeDelta load_time;
+  if (!start_time_.is_null() && time > start_time_)
+    load_time = time - start_time_;
+
+  // A module loaded by several processes keeps its earliest load time.
+  std::wstring path(StringToLowerASCII(module_info.image_file_name));
+  std::pair<ColdStartRun::ModuleMap::iterator, bool> inserted =
+      run_->modules.insert(std::make_pair(path, ColdStartModule()));
+  if (inserted.second || load_time < inserted.first->second.load_time)
+    inserted.first->second.load_time = load_time;
+
+  LoadedModule& loaded = process_it->second[module_info.base_address];
+  loaded.size = module_info.module_size;
+  loaded.module = inserted.first;
+}
+
+void ColdStartRecorder::OnTransitionFault(DWORD process_id,
+                                          DWORD thread_id,
+                                          const base::Time& time,
+                                          sym_util::Address address,
+                                          sym_util::Address program_counter) {
+}
+
+void ColdStartRecorder::OnDemandZeroFault(DWORD process_id,
+                                          DWORD thread_id,
+                                          const base::Time& time,
+                                          sym_util::Address address,
+                                          sym_util::Address program_counter) {
+}
+
+void ColdStartRecorder::OnCopyOnWriteFault(DWORD process_id,
+                                           DWORD thread_id,
+                                           const base::Time& time,
+                                           sym_util::Address address,
+                                           sym_util::Address program_counter) {
+}
+
+void ColdStartRecorder::OnGuardPageFault(DWORD process_id,
+                                         DWORD thread_id,
+                                         const base::Time& time,
+                                         sym_util::Address address,
+                                         sym_util::Address program_counter) {
+}
+
+void ColdStartRecorder::OnHardFault(DWORD process_id,
+                                    DWORD thread_id,
+                                    const base::Time& time,
+                                    sym_util::Address address,
+                                    sym_util::Address program_counter) {
+  ProcessMap::iterator process_it = processes_.find(process_id);
+  if (process_it == processes_.end())
+    return;
+
+  ++run_->hard_faults;
+
+  // Find the last module starting at or before the faulting address.
+  ProcessModules& modules = process_it->second;
+  ProcessModules::iterator it = modules.upper_bound(address);
+  if (it != modules.begin()) {
+    --it;
+    if (address - it->first < it->second.size) {
+      ++it->second.module->second.hard_faults;
+      return;
+    }
+  }
+
+  ++run_->unattributed_hard_faults;
+}
+
+void ColdStartRecorder::OnAccessViolationFault(
+    DWORD process_id,
+    DWORD thread_id,
+    const base::Time& time,
+    sym_util::Address address,
+    sym_util::Address program_counter) {
+}
+
+void ColdStartRecorder::OnHardPageFault(DWORD thread_id,
+                                        const base::Time& time,
+                                        const base::Time& initial_time,
+                                        sym_util::Offset offset,
+                                        sym_util::Address address,
+                                        sym_util::Address file_object,
+                                        sym_util::ByteCount byte_count) {
+  // These carry no process ID, so the hard faults are counted through
+  // OnHardFault instead.
+}
+
+void ColdStartRecorder::OnProcessIsRunning(const base::Time& time,
+                                           const ProcessInfo& process_info) {
+  // The launched process and its descendants all start after the session.
+}
+
+void ColdStartRecorder::OnProcessStarted(const base::Time& time,
+                                         const ProcessInfo& process_info) {
+  if (process_info.process_id == process_id_) {
+    start_time_ = time;
+  } else if (processes_.find(process_info.parent_id) == processes_.end()) {
+    return;
+  }
+
+  processes_[process_info.process_id].clear();
+  ++run_->process_count;
+}
+
+void ColdStartRecorder::OnProcessEnded(const base::Time& time,
+                                       const ProcessInfo& process_info,
+                                       ULONG exit_status) {
+  processes_.erase(process_info.process_id);
+}
+
+ColdStartSummary::ColdStartSummary() {
+}
+
+void ColdStartSummary::AddRun(const ColdStartRun& run) {
+  runs_.push_back(run);
+}
+
+bool ColdStartSummary::OutputJSON(core::JSONFileWriter* json_file) const {
+  DCHECK(json_file != NULL);
+
+  if (!json_file->OutputKey("runs") || !json_file->OpenList())
+    return false;
+  for (size_t i = 0; i < runs_.size(); ++i) {
+    if (!OutputRun(runs_[i], json_file))
+      return false;
+  }
+  if (!json_file->CloseList())
+    return false;
+
+  // Gather the per-run values of each summarized quantity.
+  Values hard_faults;
+  Values unattributed_hard_faults;
+  ModuleValuesMap modules;
+  for (size_t i = 0; i < runs_.size(); ++i) {
+    const ColdStartRun& run = runs_[i];
+    hard_faults.push_back(run.hard_faults);
+    unattributed_hard_faults.push_back(run.unattributed_hard_faults);
+
+    ColdStartRun::ModuleMap::const_iterator it = run.modules.begin();
+    for (; it != run.modules.end(); ++it) {
+      ModuleValues& values = modules[it->first];
+      values.hard_faults.push_back(it->second.hard_faults);
+      values.load_times.push_back(it->second.load_time.InMillisecondsF());
+    }
+  }
+
+  if (!json_file->OutputKey("summary") ||
+      !json_file->OpenDict() ||
+      !OutputStatistics("hard_faults", &hard_faults, json_file) ||
+      !OutputStatistics("unattributed_hard_faults", &unattributed_hard_faults,
+                        json_file) ||
+      !json_file->OutputKey("modules") ||
+      !json_file->OpenList()) {
+    return false;
+  }
+
+  ModuleValuesMap::iterator it = modules.begin();
+  for (; it != modules.end(); ++it) {
+    if (!json_file->OpenDict() ||
+        !json_file->OutputKey("path") ||
+        !json_file->OutputString(it->first) ||
+        !json_file->OutputKey("runs") ||
+        !json_file->OutputInteger(it->second.hard_faults.size()) ||
+        !OutputStatistics("hard_faults", &it->second.hard_faults, json_file) ||
+        !OutputStatistics("load_time_ms", &it->second.load_times,
+                          json_file) ||
+        !json_file->CloseDict()) {
+      return false;
+    }
+  }
+
+  if (!json_file->CloseList() || !json_file->CloseDict())
+    return false;
+
+  return true;
+}
+
+}  // namespace etw_control
+}  // namespace trace
@@ -0,0 +1,243 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the ColdStartRecorder, which gathers the hard page faults and the
+// image loads of a launched process from an NT Kernel Logger trace, and the
+// ColdStartSummary, which aggregates several such recordings.
+
+#ifndef SYZYGY_TRACE_ETW_CONTROL_COLD_START_RECORDER_H_
+#define SYZYGY_TRACE_ETW_CONTROL_COLD_START_RECORDER_H_
+
+#include <windows.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/time.h"
+#include "sawbuck/log_lib/kernel_log_consumer.h"
+#include "syzygy/core/json_file_writer.h"
+
+namespace trace {
+namespace etw_control {
+
+// The hard page faults and the load time of a module during a cold start.
+struct ColdStartModule {
+  ColdStartModule() : hard_faults(0) {
+  }
+
+  // The number of hard page faults on the module's image.
+  size_t hard_faults;
+
+  // The time from the start of the launched process to the first load of the
+  // module.
+  base::TimeDelta load_time;
+};
+
+// The outcome of a single cold start.
+struct ColdStartRun {
+  // The modules, keyed by their lower-cased path.
+  typedef std::map<std::wstring, ColdStartModule> ModuleMap;
+
+  ColdStartRun() : process_count(0), hard_faults(0),
+      unattributed_hard_faults(0) {
+  }
+
+  // The number of processes recorded: the launched process and all of its
+  // descendants.
+  size_t process_count;
+
+  // The total number of hard page faults in the recorded processes.
+  size_t hard_faults;
+
+  // The number of hard page faults outside of any module image. These hit
+  // data files, or memory that was paged out.
+  size_t unattributed_hard_faults;
+
+  // The modules loaded by the recorded processes.
+  ModuleMap modules;
+};
+
+// Records a ColdStartRun from the events of a kernel log. This tracks the
+// launched process and the processes it starts, along with the modules they
+// load, and attributes their hard page faults to those modules.
+//
+// ColdStartRun run;
+// ColdStartRecorder recorder(process_id, &run);
+// KernelLogConsumer consumer;
+// consumer.set_module_event_sink(&recorder);
+// consumer.set_page_fault_event_sink(&recorder);
+// consumer.set_process_event_sink(&recorder);
+// ... consume the kernel log ...
+class ColdStartRecorder
+    : public KernelModuleEvents,
+      public KernelPageFaultEvents,
+      public KernelProcessEvents {
+ public:
+  // @param process_id the ID of the launched process.
+  // @param run receives the recording. It must outlive this object.
+  ColdStartRecorder(DWORD process_id, ColdStartRun* run);
+
+  // @name KernelModuleEvents implementation.
+  // @{
+  virtual void OnModuleIsLoaded(DWORD process_id,
+                                const base::Time& time,
+                                const ModuleInformation& module_info) OVERRIDE;
+  virtual void OnModuleUnload(DWORD process_id,
+                              const base::Time& time,
+                              const ModuleInformation& module_info) OVERRIDE;
+  virtual void OnModuleLoad(DWORD process_id,
+                            const base::Time& time,
+                            const ModuleInformation& module_info) OVERRIDE;
+  // @}
+
+  // @name KernelPageFaultEvents implementation.
+  // @{
+  virtual void OnTransitionFault(DWORD process_id,
+                                 DWORD thread_id,
+                                 const base::Time& time,
+                                 sym_util::Address address,
+                                 sym_util::Address program_counter) OVERRIDE;
+  virtual void OnDemandZeroFault(DWORD process_id,
+                                 DWORD thread_id,
+                                 const base::Time& time,
+                                 sym_util::Address address,
+                                 sym_util::Address program_counter) OVERRIDE;
+  virtual void OnCopyOnWriteFault(DWORD process_id,
+                                  DWORD thread_id,
+                                  const base::Time& time,
+                                  sym_util::Address address,
+                                  sym_util::Address program_counter) OVERRIDE;
+  virtual void OnGuardPageFault(DWORD process_id,
+                                DWORD thread_id,
+                                const base::Time& time,
+                                sym_util::Address address,
+                                sym_util::Address program_counter) OVERRIDE;
+  virtual void OnHardFault(DWORD process_id,
+                           DWORD thread_id,
+                           const base::Time& time,
+                           sym_util::Address address,
+                           sym_util::Address program_counter) OVERRIDE;
+  virtual void OnAccessViolationFault(
+      DWORD process_id,
+      DWORD thread_id,
+      const base::Time& time,
+      sym_util::Address address,
+      sym_util::Address program_counter) OVERRIDE;
+  virtual void OnHardPageFault(DWORD thread_id,
+                               const base::Time& time,
+                               const base::Time& initial_time,
+                               sym_util::Offset offset,
+                               sym_util::Address address,
+                               sym_util::Address file_object,
+                               sym_util::ByteCount byte_count) OVERRIDE;
+  // @}
+
+  // @name KernelProcessEvents implementation.
+  // @{
+  virtual void OnProcessIsRunning(const base::Time& time,
+                                  const ProcessInfo& process_info) OVERRIDE;
+  virtual void OnProcessStarted(const base::Time& time,
+                                const ProcessInfo& process_info) OVERRIDE;
+  virtual void OnProcessEnded(const base::Time& time,
+                              const ProcessInfo& process_info,
+                              ULONG exit_status) OVERRIDE;
+  // @}
+
+ protected:
+  // A module loaded in a recorded process.
+  struct LoadedModule {
+    sym_util::ModuleSize size;
+    ColdStartRun::ModuleMap::iterator module;
+  };
+  // The modules of a recorded process, keyed by their base address.
+  typedef std::map<sym_util::ModuleBase, LoadedModule> ProcessModules;
+  typedef std::map<DWORD, ProcessModules> ProcessMap;
+
+  // The ID of the launched process.
+  DWORD process_id_;
+
+  // The start time of the launched process, or a null time until it is seen.
+  base::Time start_time_;
+
+  // The processes currently being recorded.
+  ProcessMap processes_;
+
+  // The recording.
+  ColdStartRun* run_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ColdStartRecorder);
+};
+
+// Aggregates the ColdStartRuns of several cold starts, and summarizes them.
+class ColdStartSummary {
+ public:
+  typedef std::vector<ColdStartRun> ColdStartRuns;
+
+  ColdStartSummary();
+
+  // Adds a run to the summary.
+  // @param run the run to add.
+  void AddRun(const ColdStartRun& run);
+
+  // @returns the runs added to the summary.
+  const ColdStartRuns& runs() const { return runs_; }
+
+  // Outputs the runs and their summary to the JSON dictionary currently open
+  // in @p json_file, as the "runs" and "summary" keys. Each summarized
+  // quantity is reported through its minimum, maximum, mean and median.
+  // {
+  //   "runs": [
+  //     {
+  //       "process_count": 1,
+  //       "hard_faults": 120,
+  //       "unattributed_hard_faults": 15,
+  //       "modules": [
+  //         {
+  //           "path": "\\device\\harddiskvolume1\\foo\\foo.dll",
+  //           "hard_faults": 105,
+  //           "load_time_ms": 12.5
+  //         }
+  //       ]
+  //     }
+  //   ],
+  //   "summary": {
+  //     "hard_faults": { "min": 120, "max": 120, "mean": 120, "median": 120 },
+  //     "unattributed_hard_faults": { ... },
+  //     "modules": [
+  //       {
+  //         "path": "\\device\\harddiskvolume1\\foo\\foo.dll",
+  //         "runs": 1,
+  //         "hard_faults": { ... },
+  //         "load_time_ms": { ... }
+  //       }
+  //     ]
+  //   }
+  // }
+  // @param json_file the JSON file to write to.
+  // @returns true on success, false otherwise.
+  bool OutputJSON(core::JSONFileWriter* json_file) const;
+
+ protected:
+  ColdStartRuns runs_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ColdStartSummary);
+};
+
+}  // namespace etw_control
+}  // namespace trace
+
+#endif  // SYZYGY_TRACE_ETW_CONTROL_COLD_START_RECORDER_H_
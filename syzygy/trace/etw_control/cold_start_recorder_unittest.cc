@@ -0,0 +1,219 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/etw_control/cold_start_recorder.h"
+
+#include "base/file_util.h"
+#include "base/values.h"
+#include "base/json/json_reader.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+
+namespace trace {
+namespace etw_control {
+
+namespace {
+
+const DWORD kProcessId = 100;
+const DWORD kChildProcessId = 101;
+const DWORD kOtherProcessId = 200;
+const DWORD kThreadId = 1;
+
+const sym_util::ModuleBase kExeBase = 0x00400000;
+const sym_util::ModuleBase kDllBase = 0x10000000;
+const sym_util::ModuleSize kModuleSize = 0x10000;
+
+const wchar_t kExePath[] = L"\\Device\\HarddiskVolume1\\foo.exe";
+const wchar_t kDllPath[] = L"\\Device\\HarddiskVolume1\\Bar.dll";
+const wchar_t kLowerDllPath[] = L"\\device\\harddiskvolume1\\bar.dll";
+
+class ColdStartRecorderTest : public testing::Test {
+ public:
+  ColdStartRecorderTest()
+      : start_time_(base::Time::FromDoubleT(1000)),
+        recorder_(kProcessId, &run_) {
+  }
+
+  KernelProcessEvents::ProcessInfo MakeProcessInfo(DWORD process_id,
+                                                   DWORD parent_id) {
+    KernelProcessEvents::ProcessInfo info = {};
+    info.process_id = process_id;
+    info.parent_id = parent_id;
+    return info;
+  }
+
+  sym_util::ModuleInformation MakeModuleInfo(sym_util::ModuleBase base,
+                                             const wchar_t* path) {
+    sym_util::ModuleInformation info = {};
+    info.base_address = base;
+    info.module_size = kModuleSize;
+    info.image_file_name = path;
+    return info;
+  }
+
+  base::Time AtMs(int64 milliseconds) {
+    return start_time_ + base::TimeDelta::FromMilliseconds(milliseconds);
+  }
+
+  void HardFault(DWORD process_id, sym_util::Address address) {
+    recorder_.OnHardFault(process_id, kThreadId, start_time_, address, 0);
+  }
+
+  base::Time start_time_;
+  ColdStartRun run_;
+  ColdStartRecorder recorder_;
+};
+
+}  // namespace
+
+TEST_F(ColdStartRecorderTest, IgnoresOtherProcesses) {
+  recorder_.OnProcessStarted(start_time_,
+                             MakeProcessInfo(kOtherProcessId, 1));
+  recorder_.OnModuleLoad(kOtherProcessId, AtMs(1),
+                         MakeModuleInfo(kExeBase, kExePath));
+  HardFault(kOtherProcessId, kExeBase);
+
+  EXPECT_EQ(0u, run_.process_count);
+  EXPECT_EQ(0u, run_.hard_faults);
+  EXPECT_TRUE(run_.modules.empty());
+}
+
+TEST_F(ColdStartRecorderTest, AttributesHardFaults) {
+  recorder_.OnProcessStarted(start_time_, MakeProcessInfo(kProcessId, 1));
+  recorder_.OnModuleLoad(kProcessId, AtMs(2),
+                         MakeModuleInfo(kExeBase, kExePath));
+  recorder_.OnModuleLoad(kProcessId, AtMs(5),
+                         MakeModuleInfo(kDllBase, kDllPath));
+
+  HardFault(kProcessId, kExeBase);
+  HardFault(kProcessId, kExeBase + kModuleSize - 1);
+  HardFault(kProcessId, kDllBase + 0x1000);
+  // Just past the end of the module.
+  HardFault(kProcessId, kDllBase + kModuleSize);
+  // Before any module.
+  HardFault(kProcessId, 0x1000);
+
+  EXPECT_EQ(1u, run_.process_count);
+  EXPECT_EQ(5u, run_.hard_faults);
+  EXPECT_EQ(2u, run_.unattributed_hard_faults);
+  ASSERT_EQ(2u, run_.modules.size());
+
+  // The paths are lower-cased.
+  ColdStartRun::ModuleMap::const_iterator it = run_.modules.find(kLowerDllPath);
+  ASSERT_TRUE(it != run_.modules.end());
+  EXPECT_EQ(1u, it->second.hard_faults);
+  EXPECT_EQ(5, it->second.load_time.InMilliseconds());
+
+  it = run_.modules.find(L"\\device\\harddiskvolume1\\foo.exe");
+  ASSERT_TRUE(it != run_.modules.end());
+  EXPECT_EQ(2u, it->second.hard_faults);
+  EXPECT_EQ(2, it->second.load_time.InMilliseconds());
+
+  // Faults no longer hit an unloaded module.
+  recorder_.OnModuleUnload(kProcessId, AtMs(10),
+                           MakeModuleInfo(kDllBase, kDllPath));
+  HardFault(kProcessId, kDllBase);
+  EXPECT_EQ(3u, run_.unattributed_hard_faults);
+}
+
+TEST_F(ColdStartRecorderTest, FollowsChildProcesses) {
+  recorder_.OnProcessStarted(start_time_, MakeProcessInfo(kProcessId, 1));
+  recorder_.OnProcessStarted(AtMs(20),
+                             MakeProcessInfo(kChildProcessId, kProcessId));
+  recorder_.OnModuleLoad(kChildProcessId, AtMs(30),
+                         MakeModuleInfo(kDllBase, kDllPath));
+  recorder_.OnModuleLoad(kProcessId, AtMs(40),
+                         MakeModuleInfo(kDllBase, kDllPath));
+
+  HardFault(kChildProcessId, kDllBase);
+  HardFault(kProcessId, kDllBase);
+
+  EXPECT_EQ(2u, run_.process_count);
+  EXPECT_EQ(2u, run_.hard_faults);
+  ASSERT_EQ(1u, run_.modules.size());
+  EXPECT_EQ(2u, run_.modules.begin()->second.hard_faults);
+  // The earliest load is kept.
+  EXPECT_EQ(30, run_.modules.begin()->second.load_time.InMilliseconds());
+
+  // Faults in ended processes are ignored.
+  recorder_.OnProcessEnded(AtMs(50), MakeProcessInfo(kChildProcessId,
+                                                     kProcessId), 0);
+  HardFault(kChildProcessId, kDllBase);
+  EXPECT_EQ(2u, run_.hard_faults);
+}
+
+TEST(ColdStartSummaryTest, OutputJSON) {
+  ColdStartSummary summary;
+  const size_t kHardFaults[] = { 10, 40, 20 };
+  for (size_t i = 0; i < arraysize(kHardFaults); ++i) {
+    ColdStartRun run;
+    run.process_count = 1;
+    run.hard_faults = kHardFaults[i];
+    run.unattributed_hard_faults = 1;
+    ColdStartModule& module = run.modules[kLowerDllPath];
+    module.hard_faults = kHardFaults[i] - 1;
+    module.load_time = base::TimeDelta::FromMilliseconds(i + 1);
+    summary.AddRun(run);
+  }
+  EXPECT_EQ(arraysize(kHardFaults), summary.runs().size());
+
+  testing::ScopedTempFile temp_file;
+  {
+    file_util::ScopedFILE file(file_util::OpenFile(temp_file.path(), "wb"));
+    ASSERT_TRUE(file.get() != NULL);
+    core::JSONFileWriter json_file(file.get(), false);
+    ASSERT_TRUE(json_file.OpenDict());
+    ASSERT_TRUE(summary.OutputJSON(&json_file));
+    ASSERT_TRUE(json_file.CloseDict());
+    EXPECT_TRUE(json_file.Finished());
+  }
+
+  std::string json;
+  ASSERT_TRUE(file_util::ReadFileToString(temp_file.path(), &json));
+  scoped_ptr<base::Value> value(base::JSONReader::Read(json));
+  ASSERT_TRUE(value.get() != NULL);
+  const base::DictionaryValue* dict = NULL;
+  ASSERT_TRUE(value->GetAsDictionary(&dict));
+
+  const base::ListValue* runs = NULL;
+  ASSERT_TRUE(dict->GetList("runs", &runs));
+  EXPECT_EQ(arraysize(kHardFaults), runs->GetSize());
+
+  double min = 0;
+  double max = 0;
+  double mean = 0;
+  double median = 0;
+  EXPECT_TRUE(dict->GetDouble("summary.hard_faults.min", &min));
+  EXPECT_TRUE(dict->GetDouble("summary.hard_faults.max", &max));
+  EXPECT_TRUE(dict->GetDouble("summary.hard_faults.mean", &mean));
+  EXPECT_TRUE(dict->GetDouble("summary.hard_faults.median", &median));
+  EXPECT_EQ(10, min);
+  EXPECT_EQ(40, max);
+  EXPECT_NEAR(70.0 / 3, mean, 1e-6);
+  EXPECT_EQ(20, median);
+
+  const base::ListValue* modules = NULL;
+  ASSERT_TRUE(dict->GetList("summary.modules", &modules));
+  ASSERT_EQ(1u, modules->GetSize());
+  const base::DictionaryValue* module = NULL;
+  ASSERT_TRUE(modules->GetDictionary(0, &module));
+  int module_runs = 0;
+  EXPECT_TRUE(module->GetInteger("runs", &module_runs));
+  EXPECT_EQ(3, module_runs);
+  EXPECT_TRUE(module->GetDouble("load_time_ms.median", &median));
+  EXPECT_EQ(2, median);
+}
+
+}  // namespace etw_control
+}  // namespace trace
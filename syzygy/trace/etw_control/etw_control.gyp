@@ -42,5 +42,55 @@
         '<(src)/syzygy/trace/rpc/rpc.gyp:rpc_common_lib',
       ],
     },
+    {
+      'target_name': 'cold_start_lib',
+      'type': 'static_library',
+      'sources': [
+        'cold_start_app.cc',
+        'cold_start_app.h',
+        'cold_start_recorder.cc',
+        'cold_start_recorder.h',
+      ],
+      'dependencies': [
+        '<(src)/base/base.gyp:base',
+        '<(src)/sawbuck/common/common.gyp:common',
+        '<(src)/sawbuck/log_lib/log_lib.gyp:log_lib',
+        '<(src)/syzygy/common/common.gyp:common_lib',
+        '<(src)/syzygy/core/core.gyp:core_lib',
+      ],
+    },
+    {
+      'target_name': 'cold_start',
+      'type': 'executable',
+      'sources': [
+        'cold_start_main.cc',
+      ],
+      'dependencies': [
+        'cold_start_lib',
+        '<(src)/base/base.gyp:base',
+      ],
+      'run_as': {
+        'action': [
+          '$(TargetPath)',
+          '--help',
+        ],
+      },
+    },
+    {
+      'target_name': 'etw_control_unittests',
+      'type': 'executable',
+      'sources': [
+        'cold_start_app_unittest.cc',
+        'cold_start_recorder_unittest.cc',
+        'etw_control_unittests_main.cc',
+      ],
+      'dependencies': [
+        'cold_start_lib',
+        '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/common/common.gyp:common_unittest_utils',
+        '<(src)/syzygy/core/core.gyp:core_unittest_utils',
+        '<(src)/testing/gtest.gyp:gtest',
+      ],
+    },
   ],
 }
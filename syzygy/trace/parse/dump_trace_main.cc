@@ -32,6 +32,7 @@
 
 namespace {
 
+using trace::parser::FunctionEntryEvent;
 using trace::parser::Parser;
 using trace::parser::ParseEventHandler;
 using trace::parser::ModuleInformation;
@@ -51,6 +52,12 @@ const char* GetIndexedDataTypeStr(uint8 data_type) {
     case common::IndexedFrequencyData::JUMP_TABLE:
       ret = "jump-table case counts";
       break;
+    case common::IndexedFrequencyData::EDGE_COVERAGE:
+      ret = "edge coverage bitmap";
+      break;
+    case common::IndexedFrequencyData::PAGE_COVERAGE:
+      ret = "page coverage bitmap";
+      break;
     default:
       NOTREACHED();
       break;
@@ -244,6 +251,17 @@ class TraceFileDumper : public ParseEventHandler {
     indentation_ = "";
   }
 
+  virtual bool WantsFunctionEntryBatches() {
+    return false;
+  }
+
+  virtual void OnFunctionEntryBatch(DWORD process_id,
+                                    DWORD thread_id,
+                                    const FunctionEntryEvent* events,
+                                    size_t num_events) {
+    NOTREACHED() << "Function entry batches were not requested.";
+  }
+
   virtual void OnProcessAttach(base::Time time,
                                DWORD process_id,
                                DWORD thread_id,
@@ -385,6 +403,110 @@ class TraceFileDumper : public ParseEventHandler {
               samples);
   }
 
+  virtual void OnProfilerCalibration(
+      base::Time time,
+      DWORD process_id,
+      const TraceProfilerCalibration* data) OVERRIDE {
+    DCHECK(data != NULL);
+
+    ::fprintf(file_,
+              "[%012lld] OnProfilerCalibration: process-id=%d;\n"
+              "    invocation-overhead-cycles=%lld; tsc-read-cycles=%lld;\n"
+              "    num-processors=%d\n",
+              time.ToInternalValue(),
+              process_id,
+              data->invocation_overhead_cycles,
+              data->tsc_read_cycles,
+              data->num_processors);
+    for (uint32 i = 0; i < data->num_processors; ++i) {
+      ::fprintf(file_, "    tsc-offset[%d]=%lld\n", i, data->tsc_offsets[i]);
+    }
+  }
+
+  virtual void OnSampleStacks(base::Time time,
+                              DWORD process_id,
+                              const TraceSampleStacks* data) OVERRIDE {
+    DCHECK(data != NULL);
+
+    ::fprintf(file_,
+              "[%012lld] OnSampleStacks: process-id=%d;\n"
+              "    sampling-start-time=%lld; sampling-end-time=%lld;\n"
+              "    sampling-interval=%lld; num-stacks=%d; num-frames=%d\n",
+              time.ToInternalValue(),
+              process_id,
+              data->sampling_start_time,
+              data->sampling_end_time,
+              data->sampling_interval,
+              data->num_stacks,
+              data->num_frames);
+
+    const ModuleAddr* frames =
+        reinterpret_cast<const ModuleAddr*>(data->stacks + data->num_stacks);
+    for (uint32 i = 0; i < data->num_stacks; ++i) {
+      const TraceSampleStack& stack = data->stacks[i];
+      ::fprintf(file_, "    stack[%d]: id=%d; count=%d; frames=",
+                i, stack.stack_id, stack.count);
+      for (uint32 j = 0; j < stack.num_frames; ++j, ++frames)
+        ::fprintf(file_, "%s0x%08X", j == 0 ? "" : ",", *frames);
+      ::fprintf(file_, "\n");
+    }
+  }
+
+  virtual void OnClockSample(base::Time time,
+                             DWORD process_id,
+                             const TraceClockSample* data) OVERRIDE {
+    DCHECK(data != NULL);
+
+    ::fprintf(file_,
+              "[%012lld] OnClockSample: process-id=%d;\n"
+              "    qpc-frequency=%lld; reference-qpc=%lld; "
+              "reference-tsc=%lld;\n"
+              "    qpc=%lld; tsc=%lld\n",
+              time.ToInternalValue(),
+              process_id,
+              data->qpc_frequency,
+              data->reference.qpc,
+              data->reference.tsc,
+              data->sample.qpc,
+              data->sample.tsc);
+  }
+
+  virtual void OnDataPageTouches(base::Time time,
+                                 DWORD process_id,
+                                 const TraceDataPageTouches* data) OVERRIDE {
+    DCHECK(data != NULL);
+
+    ::fprintf(file_,
+              "[%012lld] OnDataPageTouches: process-id=%d;\n"
+              "    module-base-addr=0x%08X; module-size=%d;\n"
+              "    module-checksum=0x%08X; module-time-date-stamp=0x%08X;\n"
+              "    page-size=%d; num-pages=%d\n",
+              time.ToInternalValue(),
+              process_id,
+              data->module_base_addr,
+              data->module_size,
+              data->module_checksum,
+              data->module_time_date_stamp,
+              data->page_size,
+              data->num_pages);
+    for (uint32 i = 0; i < data->num_pages; ++i)
+      ::fprintf(file_, "    page[%d]: rva=0x%08X\n", i, data->page_rvas[i]);
+  }
+
+  virtual void OnBuffersDropped(base::Time time,
+                                DWORD process_id,
+                                const TraceBuffersDropped* data) OVERRIDE {
+    DCHECK(data != NULL);
+
+    ::fprintf(file_,
+              "[%012lld] OnBuffersDropped: process-id=%d;\n"
+              "    num-buffers=%d; num-bytes=%lld\n",
+              time.ToInternalValue(),
+              process_id,
+              data->num_buffers,
+              data->num_bytes);
+  }
+
  private:
   FILE* file_;
   const char* indentation_;
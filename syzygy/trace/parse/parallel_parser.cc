@@ -0,0 +1,158 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/parse/parallel_parser.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "base/memory/scoped_vector.h"
+#include "base/threading/simple_thread.h"
+#include "base/win/scoped_com_initializer.h"
+#include "syzygy/common/stage_profiler.h"
+
+namespace trace {
+namespace parser {
+
+// Consumes a single trace file on a worker thread.
+class ParallelParser::TraceFileWorker
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  explicit TraceFileWorker(const base::FilePath& trace_file_path)
+      : trace_file_path_(trace_file_path), handler_(NULL), succeeded_(false) {
+  }
+
+  // Creates the event handler and initializes the parser.
+  // @param delegate the delegate providing the event handler.
+  // @returns true on success, false otherwise.
+  bool Init(ParallelParser::Delegate* delegate) {
+    DCHECK(delegate != NULL);
+    DCHECK(handler_ == NULL);
+
+    handler_ = delegate->CreateEventHandler(&parser_);
+    if (handler_ == NULL) {
+      LOG(ERROR) << "Failed to create an event handler for \""
+                 << trace_file_path_.value() << "\".";
+      return false;
+    }
+
+    return parser_.Init(handler_);
+  }
+
+  // Destroys the event handler and closes the trace file.
+  void Destroy(ParallelParser::Delegate* delegate) {
+    DCHECK(delegate != NULL);
+
+    ignore_result(parser_.Close());
+    if (handler_ != NULL) {
+      delegate->DestroyEventHandler(handler_);
+      handler_ = NULL;
+    }
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  virtual void Run() OVERRIDE {
+    DCHECK(handler_ != NULL);
+
+    // Event handlers routinely load symbols for the modules they encounter.
+    base::win::ScopedCOMInitializer com_initializer;
+
+    succeeded_ = parser_.OpenTraceFile(trace_file_path_) && parser_.Consume();
+  }
+  // @}
+
+  // @name Accessors.
+  // @{
+  const base::FilePath& trace_file_path() const { return trace_file_path_; }
+  ParseEventHandler* handler() const { return handler_; }
+  bool succeeded() const { return succeeded_; }
+  // @}
+
+ private:
+  base::FilePath trace_file_path_;
+  Parser parser_;
+  ParseEventHandler* handler_;
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(TraceFileWorker);
+};
+
+ParallelParser::ParallelParser(size_t num_threads)
+    : num_threads_(std::max(num_threads, static_cast<size_t>(1))) {
+}
+
+void ParallelParser::OpenTraceFile(const base::FilePath& trace_file_path) {
+  DCHECK(!trace_file_path.empty());
+  trace_files_.push_back(trace_file_path);
+}
+
+bool ParallelParser::Consume(Delegate* delegate) {
+  DCHECK(delegate != NULL);
+
+  common::ScopedStageTimer timer("ParallelParser::Consume");
+
+  if (trace_files_.empty()) {
+    LOG(ERROR) << "No open trace files to consume.";
+    return false;
+  }
+
+  ScopedVector<TraceFileWorker> workers;
+  bool result = true;
+  for (size_t i = 0; i < trace_files_.size(); ++i) {
+    workers.push_back(new TraceFileWorker(trace_files_[i]));
+    if (!workers.back()->Init(delegate)) {
+      result = false;
+      break;
+    }
+  }
+
+  if (result) {
+    size_t num_threads = std::min(num_threads_, workers.size());
+    LOG(INFO) << "Consuming " << workers.size() << " trace files on "
+              << num_threads << " threads.";
+
+    base::DelegateSimpleThreadPool pool("ParallelParser",
+                                        static_cast<int>(num_threads));
+    pool.Start();
+    for (size_t i = 0; i < workers.size(); ++i)
+      pool.AddWork(workers[i]);
+    pool.JoinAll();
+
+    for (size_t i = 0; i < workers.size(); ++i) {
+      if (!workers[i]->succeeded()) {
+        LOG(ERROR) << "Failed to consume \""
+                   << workers[i]->trace_file_path().value() << "\".";
+        result = false;
+      }
+    }
+  }
+
+  // Merge the results in the order in which the trace files were opened, so
+  // that the outcome matches that of a sequential parse as closely as
+  // possible. Each handler is destroyed as soon as it has been merged.
+  for (size_t i = 0; i < workers.size(); ++i) {
+    if (result && !delegate->MergeEventHandler(workers[i]->handler())) {
+      LOG(ERROR) << "Failed to merge the results for \""
+                 << workers[i]->trace_file_path().value() << "\".";
+      result = false;
+    }
+    workers[i]->Destroy(delegate);
+  }
+
+  return result;
+}
+
+}  // namespace parser
+}  // namespace trace
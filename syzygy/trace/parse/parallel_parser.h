@@ -0,0 +1,99 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares ParallelParser, which consumes a set of trace files concurrently.
+// Each trace file is consumed on a worker thread by its own Parser, which
+// feeds its own event handler. Once all of the files have been consumed the
+// per-file handlers are merged back together by a client supplied delegate.
+//
+// This is only suitable for clients whose state can be accumulated
+// independently for each trace file. In particular, module information is
+// tracked per Parser, so each trace file must be self contained: a process
+// whose events are spread across several trace files will not see the modules
+// that were loaded in its other trace files.
+
+#ifndef SYZYGY_TRACE_PARSE_PARALLEL_PARSER_H_
+#define SYZYGY_TRACE_PARSE_PARALLEL_PARSER_H_
+
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "syzygy/trace/parse/parser.h"
+
+namespace trace {
+namespace parser {
+
+// Consumes trace files concurrently. See the file comment for details.
+class ParallelParser {
+ public:
+  // Implemented by clients of ParallelParser to provide an event handler for
+  // each trace file, and to merge them back together. All of these are called
+  // on the thread that calls Consume.
+  class Delegate {
+   public:
+    virtual ~Delegate() { }
+
+    // Creates the event handler that will receive the events of a single
+    // trace file.
+    // @param parser the parser that will feed events to the handler. This
+    //     remains valid until the handler is destroyed.
+    // @returns a new event handler, or NULL on failure.
+    virtual ParseEventHandler* CreateEventHandler(Parser* parser) = 0;
+
+    // Merges the state accumulated by an event handler. This is called once
+    // for each handler after all of the trace files have been successfully
+    // consumed, in the order in which the trace files were opened.
+    // @param handler a handler returned by CreateEventHandler.
+    // @returns true on success, false otherwise.
+    virtual bool MergeEventHandler(ParseEventHandler* handler) = 0;
+
+    // Destroys an event handler. This is called exactly once for each handler
+    // returned by CreateEventHandler, whether or not it was merged.
+    // @param handler a handler returned by CreateEventHandler.
+    virtual void DestroyEventHandler(ParseEventHandler* handler) = 0;
+  };
+
+  // @param num_threads the maximum number of trace files to consume at once.
+  explicit ParallelParser(size_t num_threads);
+
+  // Adds a trace file to the parse session.
+  // @param trace_file_path the path to the trace file.
+  void OpenTraceFile(const base::FilePath& trace_file_path);
+
+  // Consumes all of the open trace files and merges the results.
+  // @param delegate the delegate that provides and merges the event handlers.
+  // @returns true on success, false otherwise.
+  bool Consume(Delegate* delegate);
+
+  // @returns the maximum number of trace files that are consumed at once.
+  size_t num_threads() const { return num_threads_; }
+
+ protected:
+  // Forward declaration.
+  class TraceFileWorker;
+
+  // The maximum number of trace files that are consumed at once.
+  size_t num_threads_;
+
+  // The trace files to be consumed.
+  std::vector<base::FilePath> trace_files_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ParallelParser);
+};
+
+}  // namespace parser
+}  // namespace trace
+
+#endif  // SYZYGY_TRACE_PARSE_PARALLEL_PARSER_H_
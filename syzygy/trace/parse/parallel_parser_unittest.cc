@@ -0,0 +1,163 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/parse/parallel_parser.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/pe/unittest_util.h"
+
+namespace trace {
+namespace parser {
+
+namespace {
+
+// Counts the events it receives.
+class CountingHandler : public ParseEventHandlerImpl {
+ public:
+  CountingHandler() : parser_(NULL), process_started_(0), process_attach_(0) {
+  }
+
+  virtual void OnProcessStarted(base::Time time,
+                                DWORD process_id,
+                                const TraceSystemInfo* data) OVERRIDE {
+    ++process_started_;
+  }
+
+  virtual void OnProcessAttach(base::Time time,
+                               DWORD process_id,
+                               DWORD thread_id,
+                               const TraceModuleData* data) OVERRIDE {
+    ++process_attach_;
+  }
+
+  Parser* parser_;
+  size_t process_started_;
+  size_t process_attach_;
+};
+
+// Hands out CountingHandlers and sums their counts.
+class CountingDelegate : public ParallelParser::Delegate {
+ public:
+  CountingDelegate()
+      : fail_create_(false), fail_merge_(false), created_(0), merged_(0),
+        destroyed_(0) {
+  }
+
+  virtual ParseEventHandler* CreateEventHandler(Parser* parser) OVERRIDE {
+    EXPECT_TRUE(parser != NULL);
+    if (fail_create_)
+      return NULL;
+
+    CountingHandler* handler = new CountingHandler();
+    handler->parser_ = parser;
+    ++created_;
+    return handler;
+  }
+
+  virtual bool MergeEventHandler(ParseEventHandler* handler) OVERRIDE {
+    EXPECT_TRUE(handler != NULL);
+    if (fail_merge_)
+      return false;
+
+    CountingHandler* counting_handler = static_cast<CountingHandler*>(handler);
+    total_.process_started_ += counting_handler->process_started_;
+    total_.process_attach_ += counting_handler->process_attach_;
+    ++merged_;
+    return true;
+  }
+
+  virtual void DestroyEventHandler(ParseEventHandler* handler) OVERRIDE {
+    EXPECT_TRUE(handler != NULL);
+    delete static_cast<CountingHandler*>(handler);
+    ++destroyed_;
+  }
+
+  bool fail_create_;
+  bool fail_merge_;
+  size_t created_;
+  size_t merged_;
+  size_t destroyed_;
+  CountingHandler total_;
+};
+
+class ParallelParserTest : public testing::PELibUnitTest {
+ public:
+  void OpenTraceFiles(ParallelParser* parser) {
+    ASSERT_TRUE(parser != NULL);
+    for (size_t i = 0; i < arraysize(testing::kCallTraceTraceFiles); ++i) {
+      parser->OpenTraceFile(testing::GetExeTestDataRelativePath(
+          testing::kCallTraceTraceFiles[i]));
+    }
+  }
+};
+
+}  // namespace
+
+TEST_F(ParallelParserTest, ConsumeFailsWithNoTraceFiles) {
+  ParallelParser parser(2);
+  CountingDelegate delegate;
+  EXPECT_FALSE(parser.Consume(&delegate));
+  EXPECT_EQ(0u, delegate.created_);
+}
+
+TEST_F(ParallelParserTest, MatchesSequentialParse) {
+  // Consume the trace files sequentially.
+  CountingHandler sequential_handler;
+  Parser sequential_parser;
+  ASSERT_TRUE(sequential_parser.Init(&sequential_handler));
+  for (size_t i = 0; i < arraysize(testing::kCallTraceTraceFiles); ++i) {
+    ASSERT_TRUE(sequential_parser.OpenTraceFile(
+        testing::GetExeTestDataRelativePath(
+            testing::kCallTraceTraceFiles[i])));
+  }
+  ASSERT_TRUE(sequential_parser.Consume());
+  EXPECT_EQ(arraysize(testing::kCallTraceTraceFiles),
+            sequential_handler.process_started_);
+
+  // And then in parallel.
+  ParallelParser parser(2);
+  EXPECT_EQ(2u, parser.num_threads());
+  ASSERT_NO_FATAL_FAILURE(OpenTraceFiles(&parser));
+  CountingDelegate delegate;
+  ASSERT_TRUE(parser.Consume(&delegate));
+
+  EXPECT_EQ(arraysize(testing::kCallTraceTraceFiles), delegate.created_);
+  EXPECT_EQ(delegate.created_, delegate.merged_);
+  EXPECT_EQ(delegate.created_, delegate.destroyed_);
+  EXPECT_EQ(sequential_handler.process_started_,
+            delegate.total_.process_started_);
+  EXPECT_EQ(sequential_handler.process_attach_,
+            delegate.total_.process_attach_);
+}
+
+TEST_F(ParallelParserTest, ConsumeFailsWhenHandlerCreationFails) {
+  ParallelParser parser(2);
+  ASSERT_NO_FATAL_FAILURE(OpenTraceFiles(&parser));
+  CountingDelegate delegate;
+  delegate.fail_create_ = true;
+  EXPECT_FALSE(parser.Consume(&delegate));
+  EXPECT_EQ(0u, delegate.merged_);
+}
+
+TEST_F(ParallelParserTest, ConsumeFailsWhenMergeFails) {
+  ParallelParser parser(2);
+  ASSERT_NO_FATAL_FAILURE(OpenTraceFiles(&parser));
+  CountingDelegate delegate;
+  delegate.fail_merge_ = true;
+  EXPECT_FALSE(parser.Consume(&delegate));
+  EXPECT_EQ(delegate.created_, delegate.destroyed_);
+}
+
+}  // namespace parser
+}  // namespace trace
@@ -21,6 +21,8 @@
       'target_name': 'parse_lib',
       'type': 'static_library',
       'sources': [
+        'parallel_parser.cc',
+        'parallel_parser.h',
         'parse_engine.cc',
         'parse_engine.h',
         'parse_engine_rpc.cc',
@@ -31,6 +33,8 @@
         'parser.cc',
       ],
       'dependencies': [
+        '<(src)/syzygy/common/common.gyp:stage_profiler_lib',
+        '<(src)/syzygy/core/core.gyp:core_lib',
         '<(src)/syzygy/trace/common/common.gyp:trace_common_lib',
         '<(src)/syzygy/trace/rpc/rpc.gyp:rpc_common_lib',
       ],
@@ -68,6 +72,7 @@
       'target_name': 'parse_unittests',
       'type': 'executable',
       'sources': [
+        'parallel_parser_unittest.cc',
         'parse_engine_rpc_unittest.cc',
         'parse_engine_unittest.cc',
         'parse_utils_unittest.cc',
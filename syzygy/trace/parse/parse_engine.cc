@@ -19,16 +19,24 @@
 #include <wmistr.h>  // NOLINT
 #include <evntrace.h>
 
+#include <algorithm>
+
 #include "base/logging.h"
 #include "sawbuck/common/buffer_parser.h"
 #include "sawbuck/common/com_utils.h"
 #include "syzygy/trace/parse/parser.h"
+#include "syzygy/trace/protocol/compact_batch.h"
 
 namespace trace {
 namespace parser {
 
 ParseEngine::ParseEngine(const char* name, bool fail_on_module_conflict)
     : event_handler_(NULL),
+      batch_function_entries_(false),
+      function_entry_batch_process_id_(0),
+      function_entry_batch_thread_id_(0),
+      last_lookup_process_id_(0),
+      last_lookup_table_(NULL),
       error_occurred_(false),
       fail_on_module_conflict_(fail_on_module_conflict) {
   DCHECK(name != NULL);
@@ -55,22 +63,60 @@ void ParseEngine::set_event_handler(ParseEventHandler* event_handler) {
   DCHECK(event_handler_ == NULL);
   DCHECK(event_handler != NULL);
   event_handler_ = event_handler;
+  batch_function_entries_ = event_handler_->WantsFunctionEntryBatches();
+}
+
+bool ParseEngine::IsRecognizedTraceStream(
+    const TraceFileHeader& /* file_header */) {
+  return false;
+}
+
+bool ParseEngine::ConsumeTraceStreamHeader(
+    const TraceFileHeader& /* file_header */) {
+  LOG(ERROR) << "The " << name() << " parse engine doesn't support streams.";
+  return false;
+}
+
+bool ParseEngine::ConsumeTraceStreamRecord(
+    const TraceFileHeader& /* file_header */,
+    uint8* /* record */,
+    size_t /* length */) {
+  LOG(ERROR) << "The " << name() << " parse engine doesn't support streams.";
+  return false;
 }
 
 const ModuleInformation* ParseEngine::GetModuleInformation(
     uint32 process_id, AbsoluteAddress64 addr) const {
-  ProcessMap::const_iterator processes_it = processes_.find(process_id);
-  if (processes_it == processes_.end())
-    return NULL;
+  // Lookups mostly come in runs for the same process.
+  ModuleTable* table = last_lookup_table_;
+  if (table == NULL || last_lookup_process_id_ != process_id) {
+    ModuleTableMap::iterator tables_it = module_tables_.find(process_id);
+    if (tables_it == module_tables_.end())
+      return NULL;
+    table = &tables_it->second;
+    last_lookup_process_id_ = process_id;
+    last_lookup_table_ = table;
+  }
 
-  const ModuleSpace& module_space = processes_it->second;
-  ModuleSpace::Range range(addr, 1);
-  ModuleSpace::RangeMapConstIter module_it =
-      module_space.FindFirstIntersection(range);
-  if (module_it == module_space.end())
+  const std::vector<ModuleTableEntry>& entries = table->entries;
+  if (table->last_hit < entries.size()) {
+    const ModuleTableEntry& entry = entries[table->last_hit];
+    if (entry.start <= addr && addr < entry.end)
+      return entry.module_info;
+  }
+
+  // Find the last module starting at or before the address.
+  std::vector<ModuleTableEntry>::const_iterator it =
+      std::upper_bound(entries.begin(), entries.end(), addr,
+                       &ModuleTableEntry::StartsAfter);
+  if (it == entries.begin())
+    return NULL;
+  --it;
+  if (addr >= it->end)
     return NULL;
 
-  return &module_it->second;
+  table->last_hit = it - entries.begin();
+  return it->module_info;
 }
 
 bool ParseEngine::AddModuleInformation(DWORD process_id,
@@ -90,8 +136,13 @@ bool ParseEngine::AddModuleInformation(DWORD process_id,
 
   AnnotatedModuleInformation new_module_info(module_info);
 
+  // Modules are routinely reported many times over, e.g. on each thread
+  // attach. The module table only needs rebuilding when one is inserted.
+  size_t num_modules = module_space.size();
   ModuleSpace::RangeMapIter iter;
   if (module_space.FindOrInsert(range, new_module_info, &iter)) {
+    if (module_space.size() != num_modules)
+      RebuildModuleTable(process_id);
     return true;
   }
 
@@ -114,12 +165,17 @@ bool ParseEngine::AddModuleInformation(DWORD process_id,
   // Perhaps this is a case of process id reuse. In that case, we should have
   // previously seen a module unload event and marked the module information
   // as dirty.
+  bool removed_modules = false;
   while (iter->second.is_dirty) {
     module_space.Remove(iter->first);
+    removed_modules = true;
     if (module_space.FindOrInsert(range, new_module_info, &iter)) {
+      RebuildModuleTable(process_id);
       return true;
     }
   }
+  if (removed_modules)
+    RebuildModuleTable(process_id);
 
   LOG(ERROR) << "Conflicting module info for pid=" << process_id << ": "
              << module_info.image_file_name
@@ -174,6 +230,29 @@ bool ParseEngine::RemoveModuleInformation(
   return true;
 }
 
+void ParseEngine::RebuildModuleTable(uint32 process_id) {
+  // The storage of the entries is held on to, so that rebuilding a table
+  // doesn't allocate once it has grown to fit the process.
+  ModuleTable& table = module_tables_[process_id];
+  table.entries.clear();
+  table.last_hit = 0;
+
+  ProcessMap::const_iterator processes_it = processes_.find(process_id);
+  if (processes_it == processes_.end())
+    return;
+
+  // The module space is ordered by address, and so is the table.
+  const ModuleSpace& module_space = processes_it->second;
+  table.entries.reserve(module_space.size());
+  ModuleSpace::RangeMapConstIter module_it = module_space.begin();
+  for (; module_it != module_space.end(); ++module_it) {
+    ModuleTableEntry entry = { module_it->first.start(),
+                               module_it->first.end(),
+                               &module_it->second };
+    table.entries.push_back(entry);
+  }
+}
+
 bool ParseEngine::RemoveProcessInformation(DWORD process_id) {
   ProcessMap::iterator proc_iter = processes_.find(process_id);
   if (proc_iter == processes_.end()) {
@@ -202,6 +281,22 @@ bool ParseEngine::DispatchEvent(EVENT_TRACE* event) {
   bool success = false;
   TraceEventType type = static_cast<TraceEventType>(event->Header.Class.Type);
 
+  // Events that are filtered out are consumed without a trace.
+  if (!event_filter_.IsEmpty() && EventFilter::AppliesTo(type)) {
+    base::Time time(base::Time::FromFileTime(
+        reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
+    if (!event_filter_.Matches(time, event->Header.ThreadId))
+      return true;
+  }
+
+  // Any other type of event ends the current run of function entries.
+  if (type != TRACE_ENTER_EVENT && type != TRACE_BATCH_ENTER &&
+      type != TRACE_BATCH_ENTER_COMPACT) {
+    FlushFunctionEntryBatch();
+    if (error_occurred_)
+      return true;
+  }
+
   switch (type) {
     case TRACE_ENTER_EVENT:
     case TRACE_EXIT_EVENT:
@@ -212,6 +307,10 @@ bool ParseEngine::DispatchEvent(EVENT_TRACE* event) {
       success = DispatchBatchEnterEvent(event);
       break;
 
+    case TRACE_BATCH_ENTER_COMPACT:
+      success = DispatchBatchEnterCompactEvent(event);
+      break;
+
     case TRACE_PROCESS_ATTACH_EVENT:
     case TRACE_PROCESS_DETACH_EVENT:
     case TRACE_THREAD_ATTACH_EVENT:
@@ -247,6 +346,26 @@ bool ParseEngine::DispatchEvent(EVENT_TRACE* event) {
       success = DispatchSampleDataEvent(event);
       break;
 
+    case TRACE_PROFILER_CALIBRATION:
+      success = DispatchProfilerCalibrationEvent(event);
+      break;
+
+    case TRACE_SAMPLE_STACKS:
+      success = DispatchSampleStacksEvent(event);
+      break;
+
+    case TRACE_CLOCK_SAMPLE:
+      success = DispatchClockSampleEvent(event);
+      break;
+
+    case TRACE_DATA_PAGE_TOUCHES:
+      success = DispatchDataPageTouchesEvent(event);
+      break;
+
+    case TRACE_BUFFERS_DROPPED:
+      success = DispatchBuffersDroppedEvent(event);
+      break;
+
     default:
       LOG(ERROR) << "Unknown event type encountered.";
       break;
@@ -281,7 +400,12 @@ bool ParseEngine::DispatchEntryExitEvent(EVENT_TRACE* event,
 
   switch (type) {
     case TRACE_ENTER_EVENT:
-      event_handler_->OnFunctionEntry(time, process_id, thread_id, data);
+      if (batch_function_entries_) {
+        AppendToFunctionEntryBatch(time, process_id, thread_id,
+                                   data->function);
+      } else {
+        event_handler_->OnFunctionEntry(time, process_id, thread_id, data);
+      }
       break;
 
     case TRACE_EXIT_EVENT:
@@ -333,7 +457,74 @@ bool ParseEngine::DispatchBatchEnterEvent(EVENT_TRACE* event) {
       reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
   DWORD process_id = event->Header.ProcessId;
   DWORD thread_id = data->thread_id;
-  event_handler_->OnBatchFunctionEntry(time, process_id, thread_id, data);
+  if (!batch_function_entries_) {
+    event_handler_->OnBatchFunctionEntry(time, process_id, thread_id, data);
+    return true;
+  }
+
+  // All of the calls in a batch record share the record's time stamp.
+  function_entry_batch_.reserve(function_entry_batch_.size() + data->num_calls);
+  for (size_t i = 0; i < data->num_calls; ++i) {
+    AppendToFunctionEntryBatch(time, process_id, thread_id,
+                               data->calls[i].function);
+  }
+  return true;
+}
+
+bool ParseEngine::DispatchBatchEnterCompactEvent(EVENT_TRACE* event) {
+  DCHECK(event != NULL);
+  DCHECK(event_handler_ != NULL);
+  DCHECK(error_occurred_ == false);
+
+  BinaryBufferReader reader(event->MofData, event->MofLength);
+  const TraceBatchEnterCompactData* data = NULL;
+  if (!reader.Read(&data)) {
+    LOG(ERROR) << "Short or empty compact batch event.";
+    return false;
+  }
+
+  const uint8* entries = reinterpret_cast<const uint8*>(data + 1);
+  size_t entries_length = event->MofLength - sizeof(*data);
+  compact_batch_functions_.clear();
+  if (!DecodeCompactBatch(entries, entries_length, data->num_entries,
+                          &compact_batch_functions_)) {
+    LOG(ERROR) << "Short or malformed compact batch event data. Expected "
+               << data->num_entries << " entries in " << entries_length
+               << " bytes.";
+    return false;
+  }
+
+  base::Time time(base::Time::FromFileTime(
+      reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
+  DWORD process_id = event->Header.ProcessId;
+  DWORD thread_id = data->thread_id;
+  size_t num_calls = compact_batch_functions_.size();
+
+  if (batch_function_entries_) {
+    // All of the calls in a batch record share the record's time stamp.
+    function_entry_batch_.reserve(function_entry_batch_.size() + num_calls);
+    for (size_t i = 0; i < num_calls; ++i) {
+      AppendToFunctionEntryBatch(time, process_id, thread_id,
+                                 compact_batch_functions_[i]);
+    }
+    return true;
+  }
+
+  // Handlers that take whole batches see the calls as a regular batch
+  // record, without return addresses.
+  if (num_calls == 0)
+    return true;
+  size_t batch_size = FIELD_OFFSET(TraceBatchEnterData, calls) +
+      num_calls * sizeof(TraceEnterEventData);
+  compact_batch_buffer_.assign(batch_size, 0);
+  TraceBatchEnterData* batch =
+      reinterpret_cast<TraceBatchEnterData*>(&compact_batch_buffer_[0]);
+  batch->thread_id = thread_id;
+  batch->num_calls = num_calls;
+  for (size_t i = 0; i < num_calls; ++i)
+    batch->calls[i].function = compact_batch_functions_[i];
+
+  event_handler_->OnBatchFunctionEntry(time, process_id, thread_id, batch);
   return true;
 }
 
@@ -498,6 +689,157 @@ bool ParseEngine::DispatchSampleDataEvent(EVENT_TRACE* event) {
   return true;
 }
 
+bool ParseEngine::DispatchProfilerCalibrationEvent(EVENT_TRACE* event) {
+  DCHECK(event != NULL);
+  DCHECK(event_handler_ != NULL);
+  DCHECK(error_occurred_ == false);
+
+  BinaryBufferReader reader(event->MofData, event->MofLength);
+  const TraceProfilerCalibration* data = NULL;
+  if (!reader.Read(FIELD_OFFSET(TraceProfilerCalibration, tsc_offsets),
+                   &data)) {
+    LOG(ERROR) << "Short or empty TraceProfilerCalibration event.";
+    return false;
+  }
+  DCHECK(data != NULL);
+
+  // Calculate the expected size of the entire payload, headers included.
+  size_t expected_length =
+      FIELD_OFFSET(TraceProfilerCalibration, tsc_offsets) +
+      sizeof(data->tsc_offsets[0]) * data->num_processors;
+  if (event->MofLength < expected_length) {
+    LOG(ERROR) << "Payload smaller than size implied by "
+               << "TraceProfilerCalibration header.";
+    return false;
+  }
+
+  base::Time time(base::Time::FromFileTime(
+      reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
+  DWORD process_id = event->Header.ProcessId;
+  event_handler_->OnProfilerCalibration(time, process_id, data);
+
+  return true;
+}
+
+bool ParseEngine::DispatchSampleStacksEvent(EVENT_TRACE* event) {
+  DCHECK(event != NULL);
+  DCHECK(event_handler_ != NULL);
+  DCHECK(error_occurred_ == false);
+
+  BinaryBufferReader reader(event->MofData, event->MofLength);
+  const TraceSampleStacks* data = NULL;
+  if (!reader.Read(FIELD_OFFSET(TraceSampleStacks, stacks), &data)) {
+    LOG(ERROR) << "Short or empty TraceSampleStacks event.";
+    return false;
+  }
+  DCHECK(data != NULL);
+
+  // Calculate the expected size of the entire payload, headers included.
+  size_t expected_length =
+      FIELD_OFFSET(TraceSampleStacks, stacks) +
+      sizeof(data->stacks[0]) * data->num_stacks +
+      sizeof(ModuleAddr) * data->num_frames;
+  if (event->MofLength < expected_length) {
+    LOG(ERROR) << "Payload smaller than size implied by "
+               << "TraceSampleStacks header.";
+    return false;
+  }
+
+  // The stacks must account for all of the frames.
+  size_t num_frames = 0;
+  for (size_t i = 0; i < data->num_stacks; ++i)
+    num_frames += data->stacks[i].num_frames;
+  if (num_frames != data->num_frames) {
+    LOG(ERROR) << "TraceSampleStacks stacks and frames are inconsistent.";
+    return false;
+  }
+
+  base::Time time(base::Time::FromFileTime(
+      reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
+  DWORD process_id = event->Header.ProcessId;
+  event_handler_->OnSampleStacks(time, process_id, data);
+
+  return true;
+}
+
+bool ParseEngine::DispatchClockSampleEvent(EVENT_TRACE* event) {
+  DCHECK(event != NULL);
+  DCHECK(event_handler_ != NULL);
+  DCHECK(error_occurred_ == false);
+
+  BinaryBufferReader reader(event->MofData, event->MofLength);
+  const TraceClockSample* data = NULL;
+  if (!reader.Read(&data)) {
+    LOG(ERROR) << "Short or empty TraceClockSample event.";
+    return false;
+  }
+  DCHECK(data != NULL);
+
+  // An unusable sample only costs us precision, so it's not an error.
+  if (!clock_timeline_.AddSample(data->reference, data->sample,
+                                 data->qpc_frequency)) {
+    LOG(WARNING) << "Ignoring unusable clock sample.";
+  }
+
+  base::Time time(base::Time::FromFileTime(
+      reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
+  DWORD process_id = event->Header.ProcessId;
+  event_handler_->OnClockSample(time, process_id, data);
+
+  return true;
+}
+
+bool ParseEngine::DispatchDataPageTouchesEvent(EVENT_TRACE* event) {
+  DCHECK(event != NULL);
+  DCHECK(event_handler_ != NULL);
+  DCHECK(error_occurred_ == false);
+
+  BinaryBufferReader reader(event->MofData, event->MofLength);
+  const TraceDataPageTouches* data = NULL;
+  if (!reader.Read(FIELD_OFFSET(TraceDataPageTouches, page_rvas), &data)) {
+    LOG(ERROR) << "Short or empty TraceDataPageTouches event.";
+    return false;
+  }
+  DCHECK(data != NULL);
+
+  // Calculate the expected size of the entire payload, headers included.
+  size_t expected_length = FIELD_OFFSET(TraceDataPageTouches, page_rvas) +
+      sizeof(data->page_rvas[0]) * data->num_pages;
+  if (event->MofLength < expected_length) {
+    LOG(ERROR) << "Payload smaller than size implied by TraceDataPageTouches "
+               << "header.";
+    return false;
+  }
+
+  base::Time time(base::Time::FromFileTime(
+      reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
+  DWORD process_id = event->Header.ProcessId;
+  event_handler_->OnDataPageTouches(time, process_id, data);
+
+  return true;
+}
+
+bool ParseEngine::DispatchBuffersDroppedEvent(EVENT_TRACE* event) {
+  DCHECK(event != NULL);
+  DCHECK(event_handler_ != NULL);
+  DCHECK(error_occurred_ == false);
+
+  BinaryBufferReader reader(event->MofData, event->MofLength);
+  const TraceBuffersDropped* data = NULL;
+  if (!reader.Read(&data)) {
+    LOG(ERROR) << "Short or empty TraceBuffersDropped event.";
+    return false;
+  }
+  DCHECK(data != NULL);
+
+  base::Time time(base::Time::FromFileTime(
+      reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
+  DWORD process_id = event->Header.ProcessId;
+  event_handler_->OnBuffersDropped(time, process_id, data);
+
+  return true;
+}
+
 namespace {
 
 ModuleInformation ModuleTraceDataToModuleInformation(
@@ -570,5 +912,38 @@ bool ParseEngine::DispatchModuleEvent(EVENT_TRACE* event,
   return true;
 }
 
+void ParseEngine::AppendToFunctionEntryBatch(base::Time time,
+                                             DWORD process_id,
+                                             DWORD thread_id,
+                                             FuncAddr function) {
+  DCHECK(batch_function_entries_);
+
+  if (!function_entry_batch_.empty() &&
+      (function_entry_batch_process_id_ != process_id ||
+       function_entry_batch_thread_id_ != thread_id)) {
+    FlushFunctionEntryBatch();
+  }
+
+  function_entry_batch_process_id_ = process_id;
+  function_entry_batch_thread_id_ = thread_id;
+
+  FunctionEntryEvent entry = { time, function };
+  function_entry_batch_.push_back(entry);
+}
+
+void ParseEngine::FlushFunctionEntryBatch() {
+  if (function_entry_batch_.empty())
+    return;
+
+  DCHECK(event_handler_ != NULL);
+  event_handler_->OnFunctionEntryBatch(function_entry_batch_process_id_,
+                                       function_entry_batch_thread_id_,
+                                       &function_entry_batch_[0],
+                                       function_entry_batch_.size());
+
+  // Hold on to the storage for the next batch.
+  function_entry_batch_.clear();
+}
+
 }  // namespace parser
 }  // namespace trace
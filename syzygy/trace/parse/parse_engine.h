@@ -20,8 +20,10 @@
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "syzygy/pe/pe_file.h"
+#include "syzygy/trace/common/clock.h"
 #include "syzygy/trace/parse/parser.h"
 
 namespace trace {
@@ -47,6 +49,11 @@ class ParseEngine {
   // Registers an event handler with this trace-file parse engine.
   void set_event_handler(ParseEventHandler* event_handler);
 
+  // Sets the filter applied to the events dispatched to the event handler.
+  void set_event_filter(const EventFilter& event_filter) {
+    event_filter_ = event_filter;
+  }
+
   // Returns true if the file given by @p trace_file_path is parseable by this
   // parse engine.
   virtual bool IsRecognizedTraceFile(const base::FilePath& trace_file_path) = 0;
@@ -69,6 +76,37 @@ class ParseEngine {
   // @return true on success.
   virtual bool CloseAllTraceFiles() = 0;
 
+  // @name In-memory trace streams. A trace stream is laid out like a trace
+  //     file, a header followed by segment records, but its records are
+  //     handed over as they are produced rather than read from disk. Parse
+  //     engines that don't support streams fail these calls.
+  // @{
+  // Returns true if the trace stream described by @p file_header is parseable
+  // by this parse engine.
+  virtual bool IsRecognizedTraceStream(const TraceFileHeader& file_header);
+
+  // Dispatches the start of the process described by the header of a trace
+  // stream. It is an error to call this given a header that will not be
+  // recognized by the parse engine.
+  //
+  // @param file_header The header of the trace stream. This must remain
+  //     valid while records of the stream are being consumed.
+  // @return true on success.
+  virtual bool ConsumeTraceStreamHeader(const TraceFileHeader& file_header);
+
+  // Dispatches all of the events in a segment record of a trace stream.
+  //
+  // @param file_header The header of the trace stream, as previously passed
+  //     to ConsumeTraceStreamHeader().
+  // @param record The record, starting with its RecordPrefix.
+  // @param length The maximum length of the record. The length of its
+  //     segment is read from the segment header, but must fit in this.
+  // @return true on success.
+  virtual bool ConsumeTraceStreamRecord(const TraceFileHeader& file_header,
+                                        uint8* record,
+                                        size_t length);
+  // @}
+
   // Given an address and a process id, returns the module in memory at that
   // address.
   //
@@ -83,6 +121,31 @@ class ParseEngine {
   // Used to store module information about each observed process.
   typedef std::map<uint32, ModuleSpace> ProcessMap;
 
+  // A flat copy of the module space of a process, sorted by address. This is
+  // what module lookups search, as it is far cheaper than walking the module
+  // space. It's rebuilt whenever modules are added to or removed from the
+  // module space, which is rare compared to lookups.
+  struct ModuleTableEntry {
+    // Orders an address before the entries of modules starting after it.
+    static bool StartsAfter(AbsoluteAddress64 addr,
+                            const ModuleTableEntry& entry) {
+      return addr < entry.start;
+    }
+
+    AbsoluteAddress64 start;
+    AbsoluteAddress64 end;
+    const ModuleInformation* module_info;
+  };
+  struct ModuleTable {
+    ModuleTable() : last_hit(0) {}
+
+    std::vector<ModuleTableEntry> entries;
+    // The index of the entry found by the last lookup. Consecutive lookups
+    // mostly fall in the same module, and are satisfied from here.
+    size_t last_hit;
+  };
+  typedef std::map<uint32, ModuleTable> ModuleTableMap;
+
   // Initialize the base ParseEngine.
   //
   // @param name The name of this parse engine. This will be logged.
@@ -120,6 +183,12 @@ class ParseEngine {
   // @return true on success.
   bool RemoveProcessInformation(DWORD process_id);
 
+  // Rebuilds the module table of a process from its module space. This must
+  // be called whenever modules are added to or removed from the module space.
+  //
+  // @param process_id The process whose module space has changed.
+  void RebuildModuleTable(uint32 process_id);
+
   // The main entry point by which trace events are dispatched to the
   // event handler.
   //
@@ -152,6 +221,17 @@ class ParseEngine {
   //     true.
   bool DispatchBatchEnterEvent(EVENT_TRACE* event);
 
+  // Parses and dispatches compact batch function entry events. The calls are
+  // issued as for a regular batch record, with NULL return addresses. Called
+  // from DispatchEvent().
+  //
+  // @param event The event to dispatch.
+  //
+  // @return true if the event was successfully dispatched, false otherwise.
+  //     If an error occurred, the error_occurred_ flag will be set to
+  //     true.
+  bool DispatchBatchEnterCompactEvent(EVENT_TRACE* event);
+
   // Parses and dispatches a process ended event. Called from DispatchEvent().
   //
   // @param event The event to dispatch.
@@ -215,15 +295,101 @@ class ParseEngine {
   //     Does not explicitly set error occurred.
   bool DispatchSampleDataEvent(EVENT_TRACE* event);
 
+  // Parses and dispatches profiler calibration events.
+  //
+  // @param event the event to dispatch.
+  //
+  // @return true if the event was successfully dispatched, false otherwise.
+  //     Does not explicitly set error occurred.
+  bool DispatchProfilerCalibrationEvent(EVENT_TRACE* event);
+
+  // Parses and dispatches sampled stack events.
+  //
+  // @param event the event to dispatch.
+  //
+  // @return true if the event was successfully dispatched, false otherwise.
+  //     Does not explicitly set error occurred.
+  bool DispatchSampleStacksEvent(EVENT_TRACE* event);
+
+  // Parses and dispatches clock sample events, adding them to the clock
+  // timeline.
+  //
+  // @param event the event to dispatch.
+  //
+  // @return true if the event was successfully dispatched, false otherwise.
+  //     Does not explicitly set error occurred.
+  bool DispatchClockSampleEvent(EVENT_TRACE* event);
+
+  // Parses and dispatches data page touch events.
+  //
+  // @param event the event to dispatch.
+  //
+  // @return true if the event was successfully dispatched, false otherwise.
+  //     Does not explicitly set error occurred.
+  bool DispatchDataPageTouchesEvent(EVENT_TRACE* event);
+
+  // Parses and dispatches buffers dropped events.
+  //
+  // @param event the event to dispatch.
+  //
+  // @return true if the event was successfully dispatched, false otherwise.
+  //     Does not explicitly set error occurred.
+  bool DispatchBuffersDroppedEvent(EVENT_TRACE* event);
+
+  // Appends a function entry event to the pending batch, first flushing the
+  // batch if it belongs to another process or thread.
+  //
+  // @param time The time of the function entry.
+  // @param process_id The process in which the function was entered.
+  // @param thread_id The thread on which the function was entered.
+  // @param function The function that was entered.
+  void AppendToFunctionEntryBatch(base::Time time,
+                                  DWORD process_id,
+                                  DWORD thread_id,
+                                  FuncAddr function);
+
+  // Issues the pending batch of function entry events, if any, to the event
+  // handler. Engines must call this when they reach the end of a run of
+  // events, such as the end of a trace file segment.
+  void FlushFunctionEntryBatch();
+
   // The name by which this parse engine is known.
   std::string name_;
 
   // The event handler to be notified on trace events.
   ParseEventHandler* event_handler_;
 
+  // True if the event handler receives function entry events in batches.
+  bool batch_function_entries_;
+
+  // The pending batch of function entry events, and the process and thread
+  // to which it belongs.
+  std::vector<FunctionEntryEvent> function_entry_batch_;
+  DWORD function_entry_batch_process_id_;
+  DWORD function_entry_batch_thread_id_;
+
+  // Scratch space used to decode compact batch records, and to present them
+  // to the event handler as regular batch records.
+  std::vector<FuncAddr> compact_batch_functions_;
+  std::vector<uint8> compact_batch_buffer_;
+
+  // The filter applied to the events dispatched to the event handler.
+  EventFilter event_filter_;
+
+  // The timeline built from the clock samples seen so far. Engines that
+  // consume trace files one at a time use it to convert the timestamps of
+  // the current file, and reset it between files.
+  trace::common::ClockTimeline clock_timeline_;
+
   // For each process, we store its point of view of the world.
   ProcessMap processes_;
 
+  // The module tables of the processes, and the process and table of the last
+  // successful lookup. These are updated by lookups, hence mutable.
+  mutable ModuleTableMap module_tables_;
+  mutable uint32 last_lookup_process_id_;
+  mutable ModuleTable* last_lookup_table_;
+
   // Flag indicating whether or not an error has occurred in parsing the trace
   // event stream.
   bool error_occurred_;
@@ -16,10 +16,16 @@
 
 #include "syzygy/trace/parse/parse_engine_rpc.h"
 
+#include <limits>
+
 #include "base/file_util.h"
 #include "base/logging.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/win/scoped_handle.h"
 #include "sawbuck/common/com_utils.h"
 #include "syzygy/common/align.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/core/zstream.h"
 #include "syzygy/trace/parse/parse_utils.h"
 
 using common::AlignUp;
@@ -28,7 +34,188 @@ using common::AlignUp64;
 namespace trace {
 namespace parser {
 
-ParseEngineRpc::ParseEngineRpc() : ParseEngine("RPC", true) {
+namespace {
+
+// Decompresses the zlib compressed content of a segment.
+// @param compressed the compressed content.
+// @param compressed_length the length of the compressed content.
+// @param uncompressed receives the uncompressed content.
+// @param uncompressed_length the length of the uncompressed content, as
+//     recorded in the segment header.
+// @returns true on success, false otherwise.
+bool DecompressSegment(const uint8* compressed,
+                       size_t compressed_length,
+                       uint8* uncompressed,
+                       size_t uncompressed_length) {
+  if (uncompressed_length == 0)
+    return true;
+
+  DCHECK(compressed != NULL || compressed_length == 0);
+  DCHECK(uncompressed != NULL);
+  scoped_ptr<core::InStream> in_stream(core::CreateByteInStream(
+      compressed, compressed + compressed_length));
+  core::ZInStream zstream(in_stream.get());
+  if (!zstream.Init()) {
+    LOG(ERROR) << "Failed to initialize decompressor.";
+    return false;
+  }
+
+  if (!zstream.Read(uncompressed_length, uncompressed)) {
+    LOG(ERROR) << "Failed to decompress segment.";
+    return false;
+  }
+
+  return true;
+}
+
+// Maps a sliding window of a file into memory. The view is copy-on-write, as
+// the event handlers are handed writable pointers into it.
+class MappedFileWindow {
+ public:
+  MappedFileWindow()
+      : file_size_(0), view_(NULL), view_offset_(0), view_size_(0),
+        granularity_(0) {
+  }
+
+  ~MappedFileWindow() {
+    Unmap();
+  }
+
+  // Opens the file to be mapped.
+  // @param path the path of the file.
+  // @returns true on success, false otherwise.
+  bool Open(const base::FilePath& path) {
+    DCHECK(!file_.IsValid());
+
+    file_.Set(::CreateFile(path.value().c_str(), GENERIC_READ,
+                           FILE_SHARE_READ | FILE_SHARE_WRITE |
+                               FILE_SHARE_DELETE,
+                           NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
+                           NULL));
+    if (!file_.IsValid()) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Unable to open '" << path.value() << "': "
+                 << com::LogWe(error) << ".";
+      return false;
+    }
+
+    LARGE_INTEGER file_size = {};
+    if (!::GetFileSizeEx(file_.Get(), &file_size)) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Unable to get the size of '" << path.value() << "': "
+                 << com::LogWe(error) << ".";
+      return false;
+    }
+    file_size_ = file_size.QuadPart;
+
+    // It's not possible to map an empty file.
+    if (file_size_ == 0)
+      return true;
+
+    mapping_.Set(::CreateFileMapping(file_.Get(), NULL, PAGE_WRITECOPY, 0, 0,
+                                     NULL));
+    if (!mapping_.IsValid()) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Unable to map '" << path.value() << "': "
+                 << com::LogWe(error) << ".";
+      return false;
+    }
+
+    SYSTEM_INFO system_info = {};
+    ::GetSystemInfo(&system_info);
+    granularity_ = system_info.dwAllocationGranularity;
+
+    return true;
+  }
+
+  // Gets a pointer to a range of the file, sliding the window if necessary.
+  // This invalidates any pointer previously returned.
+  // @param offset the offset of the range in the file.
+  // @param length the length of the range.
+  // @param data receives a pointer to the range, or NULL if it extends past
+  //     the end of the file.
+  // @returns true on success, false on error.
+  bool GetRange(uint64 offset, size_t length, uint8** data) {
+    DCHECK(data != NULL);
+
+    *data = NULL;
+    if (offset > file_size_ || file_size_ - offset < length)
+      return true;
+
+    if (view_ == NULL || offset < view_offset_ ||
+        offset + length > view_offset_ + view_size_) {
+      if (!Map(offset, length))
+        return false;
+    }
+
+    *data = view_ + static_cast<size_t>(offset - view_offset_);
+    return true;
+  }
+
+ private:
+  // Maps a window containing the given range, which must lie in the file.
+  bool Map(uint64 offset, size_t length) {
+    Unmap();
+
+    uint64 view_offset = common::AlignDown64(offset, granularity_);
+    uint64 view_size = offset - view_offset + length;
+    if (view_size < ParseEngineRpc::kMappedWindowSize)
+      view_size = ParseEngineRpc::kMappedWindowSize;
+    if (view_size > file_size_ - view_offset)
+      view_size = file_size_ - view_offset;
+
+    view_ = reinterpret_cast<uint8*>(::MapViewOfFile(
+        mapping_.Get(), FILE_MAP_COPY,
+        static_cast<DWORD>(view_offset >> 32),
+        static_cast<DWORD>(view_offset),
+        static_cast<SIZE_T>(view_size)));
+    if (view_ == NULL) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to map " << view_size << " bytes at offset "
+                 << view_offset << ": " << com::LogWe(error) << ".";
+      return false;
+    }
+
+    view_offset_ = view_offset;
+    view_size_ = static_cast<size_t>(view_size);
+    return true;
+  }
+
+  void Unmap() {
+    if (view_ == NULL)
+      return;
+    if (!::UnmapViewOfFile(view_)) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to unmap view: " << com::LogWe(error) << ".";
+    }
+    view_ = NULL;
+    view_offset_ = 0;
+    view_size_ = 0;
+  }
+
+  base::win::ScopedHandle file_;
+  base::win::ScopedHandle mapping_;
+  uint64 file_size_;
+
+  // The currently mapped window, if any.
+  uint8* view_;
+  uint64 view_offset_;
+  size_t view_size_;
+
+  // The alignment of view offsets.
+  DWORD granularity_;
+
+  DISALLOW_COPY_AND_ASSIGN(MappedFileWindow);
+};
+
+}  // namespace
+
+ParseEngineRpc::ParseEngineRpc()
+    : ParseEngine("RPC", true), read_mode_(kMappedRead) {
+}
+
+ParseEngineRpc::ParseEngineRpc(ReadMode read_mode)
+    : ParseEngine("RPC", true), read_mode_(read_mode) {
 }
 
 ParseEngineRpc::~ParseEngineRpc() {
@@ -81,11 +268,66 @@ bool ParseEngineRpc::ConsumeAllEvents() {
   return true;
 }
 
+bool ParseEngineRpc::IsRecognizedTraceStream(
+    const TraceFileHeader& file_header) {
+  return 0 == ::memcmp(&file_header.signature,
+                       &TraceFileHeader::kSignatureValue,
+                       sizeof(file_header.signature));
+}
+
+bool ParseEngineRpc::ConsumeTraceStreamHeader(
+    const TraceFileHeader& file_header) {
+  if (!IsRecognizedTraceStream(file_header)) {
+    LOG(ERROR) << "Not a valid RPC call-trace stream.";
+    return false;
+  }
+
+  // Unlike trace files, the streams consumed by a parse session are
+  // interleaved, so the clock samples they provide are kept for all of them.
+  // They all come from the machine the parse session runs on.
+  return ConsumeTraceFileHeader(file_header);
+}
+
+bool ParseEngineRpc::ConsumeTraceStreamRecord(
+    const TraceFileHeader& file_header,
+    uint8* record,
+    size_t length) {
+  DCHECK(record != NULL);
+
+  const size_t kHeaderLength =
+      sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
+  if (length < kHeaderLength) {
+    LOG(ERROR) << "Trace stream record is too short.";
+    return false;
+  }
+
+  RecordPrefix* segment_prefix = reinterpret_cast<RecordPrefix*>(record);
+  if (!IsSegmentPrefixValid(*segment_prefix))
+    return false;
+
+  // The producer of the record may still be writing to it, so its segment
+  // length is only read once. An empty segment holds no events.
+  size_t header_length = sizeof(RecordPrefix) + segment_prefix->size;
+  size_t segment_length = reinterpret_cast<TraceFileSegmentHeader*>(
+      segment_prefix + 1)->segment_length;
+  if (segment_length == 0)
+    return true;
+  if (header_length > length || segment_length > length - header_length) {
+    LOG(ERROR) << "Invalid segment length " << segment_length << ".";
+    return false;
+  }
+
+  return ConsumeSegmentRecord(file_header, segment_prefix, segment_length);
+}
+
 bool ParseEngineRpc::ConsumeTraceFile(const base::FilePath& trace_file_path) {
   DCHECK(!trace_file_path.empty());
 
   LOG(INFO) << "Processing '" << trace_file_path.BaseName().value() << "'.";
 
+  // Clock samples only apply to the trace file they appear in.
+  clock_timeline_.Reset();
+
   file_util::ScopedFILE trace_file(file_util::OpenFile(trace_file_path, "rb"));
   if (!trace_file.get()) {
     DWORD error = ::GetLastError();
@@ -138,19 +380,55 @@ bool ParseEngineRpc::ConsumeTraceFile(const base::FilePath& trace_file_path) {
     return false;
   }
 
+  if (!ConsumeTraceFileHeader(*file_header))
+    return false;
+
+  // Consume the body of the trace file. When events are being filtered and
+  // the trace file is indexed, we only visit the segments of interest.
+  uint64 first_segment = AlignUp64(file_header->header_size,
+                                   file_header->block_size);
+  std::vector<uint64> segment_offsets;
+  const std::vector<uint64>* segments_of_interest = NULL;
+  std::vector<TraceFileIndexEntry> index;
+  if (!event_filter_.IsEmpty() &&
+      ReadTraceFileIndex(trace_file.get(), *file_header, first_segment,
+                         &index)) {
+    for (size_t i = 0; i < index.size(); ++i) {
+      if (IsSegmentOfInterest(*file_header, index[i]))
+        segment_offsets.push_back(index[i].segment_offset);
+    }
+    segments_of_interest = &segment_offsets;
+    LOG(INFO) << "Consuming " << segment_offsets.size() << " of "
+              << index.size() << " indexed segments.";
+  }
+
+  if (read_mode_ == kMappedRead) {
+    trace_file.reset();
+    return ConsumeMappedSegments(trace_file_path, *file_header, first_segment,
+                                 segments_of_interest);
+  }
+
+  return ConsumeBufferedSegments(trace_file.get(), *file_header,
+                                 first_segment, segments_of_interest);
+}
+
+bool ParseEngineRpc::ConsumeTraceFileHeader(
+    const TraceFileHeader& file_header) {
+  DCHECK(event_handler_ != NULL);
+
   // Populate the system information which will be fed to the OnProcessStarted
   // event.
   TraceSystemInfo system_info = {};
-  system_info.os_version_info = file_header->os_version_info;
-  system_info.system_info = file_header->system_info;
-  system_info.memory_status = file_header->memory_status;
-  system_info.clock_info = file_header->clock_info;
+  system_info.os_version_info = file_header.os_version_info;
+  system_info.system_info = file_header.system_info;
+  system_info.memory_status = file_header.memory_status;
+  system_info.clock_info = file_header.clock_info;
 
   // Parse the header blob. This fails if there is any extra data, enforcing
   // a valid header size as a side effect.
   std::wstring module_path;
   std::wstring command_line;
-  if (!ParseTraceFileHeaderBlob(*file_header, &module_path, &command_line,
+  if (!ParseTraceFileHeaderBlob(file_header, &module_path, &command_line,
                                 &system_info.environment_strings)) {
     LOG(ERROR) << "Unable to parse trace file header blob.";
     return false;
@@ -160,26 +438,163 @@ bool ParseEngineRpc::ConsumeTraceFile(const base::FilePath& trace_file_path) {
   // case the executable itself is instrumented, so that trace events will map
   // to a module in the process map.
   ModuleInformation module_info = {};
-  module_info.base_address = file_header->module_base_address;
+  module_info.base_address = file_header.module_base_address;
   module_info.image_file_name = module_path;
-  module_info.module_size = file_header->module_size;
-  module_info.image_checksum = file_header->module_checksum;
-  module_info.time_date_stamp = file_header->module_time_date_stamp;
-  AddModuleInformation(file_header->process_id, module_info);
+  module_info.module_size = file_header.module_size;
+  module_info.image_checksum = file_header.module_checksum;
+  module_info.time_date_stamp = file_header.module_time_date_stamp;
+  AddModuleInformation(file_header.process_id, module_info);
 
   // Notify the event handler that a process has started.
   base::Time start_time(base::Time::FromFileTime(
-      file_header->clock_info.file_time));
-  event_handler_->OnProcessStarted(start_time, file_header->process_id,
+      file_header.clock_info.file_time));
+  event_handler_->OnProcessStarted(start_time, file_header.process_id,
                                    &system_info);
 
-  // Consume the body of the trace file.
-  uint64 next_segment = AlignUp64(file_header->header_size,
-                                  file_header->block_size);
+  return true;
+}
+
+bool ParseEngineRpc::ReadTraceFileIndex(
+    FILE* trace_file,
+    const TraceFileHeader& file_header,
+    uint64 first_segment,
+    std::vector<TraceFileIndexEntry>* entries) {
+  DCHECK(trace_file != NULL);
+  DCHECK(entries != NULL);
+
+  entries->clear();
+
+  // The footer occupies the last bytes of an indexed trace file. Anything
+  // that doesn't look like one simply means there's no index.
+  TraceFileIndexFooter footer = {};
+  if (::_fseeki64(trace_file, -static_cast<int64>(sizeof(footer)),
+                  SEEK_END) != 0) {
+    return false;
+  }
+  int64 footer_offset = ::_ftelli64(trace_file);
+  if (footer_offset < 0 || static_cast<uint64>(footer_offset) < first_segment ||
+      ::fread(&footer, sizeof(footer), 1, trace_file) != 1 ||
+      ::memcmp(&footer.signature, &TraceFileIndexFooter::kSignatureValue,
+               sizeof(footer.signature)) != 0) {
+    return false;
+  }
+
+  // From here on a malformed index is worth a warning, but not a failure; the
+  // trace file can still be consumed in its entirety.
+  const size_t kHeaderLength =
+      sizeof(RecordPrefix) + sizeof(TraceFileIndexHeader);
+  if (footer.index_offset < first_segment ||
+      footer.index_offset % file_header.block_size != 0 ||
+      footer.index_size < kHeaderLength ||
+      footer.index_offset + footer.index_size >
+          static_cast<uint64>(footer_offset)) {
+    LOG(WARNING) << "Ignoring invalid trace file index footer.";
+    return false;
+  }
+
+  RecordPrefix prefix = {};
+  TraceFileIndexHeader header = {};
+  if (::_fseeki64(trace_file, footer.index_offset, SEEK_SET) != 0 ||
+      ::fread(&prefix, sizeof(prefix), 1, trace_file) != 1 ||
+      ::fread(&header, sizeof(header), 1, trace_file) != 1) {
+    LOG(WARNING) << "Failed to read trace file index header.";
+    return false;
+  }
+
+  if (prefix.type != TraceFileIndexHeader::kTypeId ||
+      prefix.size != sizeof(TraceFileIndexHeader) ||
+      prefix.version.hi != TRACE_VERSION_HI ||
+      prefix.version.lo != TRACE_VERSION_LO ||
+      header.entry_size < sizeof(TraceFileIndexEntry) ||
+      static_cast<uint64>(header.num_entries) * header.entry_size !=
+          footer.index_size - kHeaderLength) {
+    LOG(WARNING) << "Ignoring invalid trace file index header.";
+    return false;
+  }
+
+  // Entries may be larger than we know of; we read the fields we know of and
+  // skip the rest.
+  std::vector<uint8> raw_entry(header.entry_size);
+  entries->resize(header.num_entries);
+  for (size_t i = 0; i < entries->size(); ++i) {
+    if (::fread(&raw_entry[0], raw_entry.size(), 1, trace_file) != 1) {
+      LOG(WARNING) << "Failed to read trace file index entry.";
+      entries->clear();
+      return false;
+    }
+
+    TraceFileIndexEntry& entry = (*entries)[i];
+    ::memcpy(&entry, &raw_entry[0], sizeof(entry));
+    if (entry.segment_offset < first_segment ||
+        entry.segment_offset >= footer.index_offset ||
+        (i > 0 && entry.segment_offset <= (*entries)[i - 1].segment_offset)) {
+      LOG(WARNING) << "Ignoring trace file index with invalid entries.";
+      entries->clear();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool ParseEngineRpc::IsSegmentOfInterest(
+    const TraceFileHeader& file_header,
+    const TraceFileIndexEntry& entry) const {
+  for (size_t i = 0; i < TraceFileIndexEntry::kNumCountedTypes; ++i) {
+    TraceEventType type = static_cast<TraceEventType>(
+        TraceFileIndexEntry::kFirstCountedType + i);
+    if (entry.record_counts[i] != 0 && !EventFilter::AppliesTo(type))
+      return true;
+  }
+
+  FILETIME first_time = {};
+  FILETIME last_time = {};
+  trace::common::TscToFileTime(file_header.clock_info,
+                               entry.first_timestamp,
+                               &first_time);
+  trace::common::TscToFileTime(file_header.clock_info,
+                               entry.last_timestamp,
+                               &last_time);
+  return event_filter_.MayMatch(base::Time::FromFileTime(first_time),
+                                base::Time::FromFileTime(last_time),
+                                entry.thread_id);
+}
+
+bool ParseEngineRpc::TscToFileTime(const TraceFileHeader& file_header,
+                                   uint64 tsc,
+                                   FILETIME* file_time) const {
+  DCHECK(file_time != NULL);
+
+  if (clock_timeline_.num_samples() > 0 &&
+      clock_timeline_.TscToFileTime(file_header.clock_info.tsc_info,
+                                    tsc,
+                                    file_time)) {
+    return true;
+  }
+
+  return trace::common::TscToFileTime(file_header.clock_info, tsc, file_time);
+}
+
+bool ParseEngineRpc::ConsumeBufferedSegments(
+    FILE* trace_file,
+    const TraceFileHeader& file_header,
+    uint64 first_segment,
+    const std::vector<uint64>* segment_offsets) {
+  DCHECK(trace_file != NULL);
+
+  uint64 next_segment = first_segment;
+  size_t next_segment_index = 0;
   scoped_ptr_malloc<uint8> buffer;
   size_t buffer_size = 0;
+  std::vector<uint8> compressed_buffer;
   while (true) {
-    if (::_fseeki64(trace_file.get(), next_segment, SEEK_SET) != 0) {
+    if (segment_offsets != NULL) {
+      if (next_segment_index == segment_offsets->size())
+        break;
+      next_segment = (*segment_offsets)[next_segment_index++];
+    }
+
+    if (::_fseeki64(trace_file, next_segment, SEEK_SET) != 0) {
       LOG(ERROR) << "Failed to seek segment boundary " << next_segment << ".";
       return false;
     }
@@ -188,61 +603,238 @@ bool ParseEngineRpc::ConsumeTraceFile(const base::FilePath& trace_file_path) {
     if (::fread(&segment_prefix,
                 sizeof(segment_prefix),
                 1,
-                trace_file.get()) != 1) {
-      if (::feof(trace_file.get()))
+                trace_file) != 1) {
+      if (::feof(trace_file))
         break;
 
       LOG(ERROR) << "Failed to read segment header prefix.";
       return false;
     }
 
-    if (segment_prefix.type != TraceFileSegmentHeader::kTypeId ||
-        segment_prefix.size != sizeof(TraceFileSegmentHeader) ||
-        segment_prefix.version.hi != TRACE_VERSION_HI ||
-        segment_prefix.version.lo != TRACE_VERSION_LO) {
-      LOG(ERROR) << "Unrecognized record prefix for segment header.";
+    // The index follows the last segment.
+    if (segment_prefix.type == TraceFileIndexHeader::kTypeId)
+      break;
+
+    if (!IsSegmentPrefixValid(segment_prefix))
       return false;
+
+    // The number of bytes following the segment prefix on disk. This differs
+    // from the size of the segment header and content if they're compressed.
+    size_t stored_length = 0;
+    if (segment_prefix.type == TraceFileSegmentHeader::kTypeId) {
+      TraceFileSegmentHeader segment_header;
+      if (::fread(&segment_header,
+                  sizeof(segment_header),
+                  1,
+                  trace_file) != 1) {
+        LOG(ERROR) << "Failed to read segment header.";
+        return false;
+      }
+
+      size_t aligned_size = AlignUp(segment_header.segment_length,
+                                    file_header.block_size);
+
+      if (aligned_size > buffer_size) {
+        buffer.reset(reinterpret_cast<uint8*>(::malloc(aligned_size)));
+        buffer_size = aligned_size;
+      }
+
+      if (::fread(buffer.get(), segment_header.segment_length, 1,
+                  trace_file) != 1) {
+        LOG(ERROR) << "Failed to read segment.";
+        return false;
+      }
+
+      if (!ConsumeSegmentEvents(file_header,
+                                segment_header,
+                                buffer.get(),
+                                segment_header.segment_length)) {
+        return false;
+      }
+
+      stored_length = sizeof(segment_header) + segment_header.segment_length;
+    } else {
+      TraceFileCompressedSegmentHeader compressed_header;
+      if (::fread(&compressed_header,
+                  sizeof(compressed_header),
+                  1,
+                  trace_file) != 1) {
+        LOG(ERROR) << "Failed to read compressed segment header.";
+        return false;
+      }
+
+      compressed_buffer.resize(compressed_header.segment_length);
+      if (!compressed_buffer.empty() &&
+          ::fread(&compressed_buffer[0], compressed_buffer.size(), 1,
+                  trace_file) != 1) {
+        LOG(ERROR) << "Failed to read compressed segment.";
+        return false;
+      }
+
+      if (!ConsumeCompressedSegmentEvents(
+              file_header,
+              compressed_header,
+              compressed_buffer.empty() ? NULL : &compressed_buffer[0])) {
+        return false;
+      }
+
+      stored_length = sizeof(compressed_header) +
+          compressed_header.segment_length;
     }
 
-    TraceFileSegmentHeader segment_header;
-    if (::fread(&segment_header,
-                sizeof(segment_header),
-                1,
-                trace_file.get()) != 1) {
-      LOG(ERROR) << "Failed to read segment header.";
-      return false;
+    next_segment = AlignUp64(
+        next_segment + sizeof(segment_prefix) + stored_length,
+        file_header.block_size);
+  }
+
+  return true;
+}
+
+bool ParseEngineRpc::ConsumeMappedSegments(
+    const base::FilePath& trace_file_path,
+    const TraceFileHeader& file_header,
+    uint64 first_segment,
+    const std::vector<uint64>* segment_offsets) {
+  MappedFileWindow window;
+  if (!window.Open(trace_file_path))
+    return false;
+
+  // Each lookup in the window may slide it, invalidating the pointers it
+  // previously handed out, so we look up each segment as a whole before
+  // consuming it.
+  uint64 next_segment = first_segment;
+  size_t next_segment_index = 0;
+  while (true) {
+    if (segment_offsets != NULL) {
+      if (next_segment_index == segment_offsets->size())
+        break;
+      next_segment = (*segment_offsets)[next_segment_index++];
     }
 
-    size_t aligned_size = AlignUp(segment_header.segment_length,
-                                  file_header->block_size);
+    uint8* data = NULL;
+    if (!window.GetRange(next_segment, sizeof(RecordPrefix), &data))
+      return false;
+    if (data == NULL)
+      break;
 
-    if (aligned_size > buffer_size) {
-      buffer.reset(reinterpret_cast<uint8*>(::malloc(aligned_size)));
-      buffer_size = aligned_size;
+    RecordPrefix* segment_prefix = reinterpret_cast<RecordPrefix*>(data);
+
+    // The index follows the last segment.
+    if (segment_prefix->type == TraceFileIndexHeader::kTypeId)
+      break;
+
+    if (!IsSegmentPrefixValid(*segment_prefix))
+      return false;
+
+    // The segment header has its length at the same offset regardless of
+    // whether it's compressed.
+    size_t header_length = sizeof(RecordPrefix) + segment_prefix->size;
+    if (!window.GetRange(next_segment, header_length, &data))
+      return false;
+    if (data == NULL) {
+      LOG(ERROR) << "Failed to read segment header.";
+      return false;
+    }
+    segment_prefix = reinterpret_cast<RecordPrefix*>(data);
+    COMPILE_ASSERT(offsetof(TraceFileSegmentHeader, segment_length) ==
+                       offsetof(TraceFileCompressedSegmentHeader,
+                                segment_length),
+                   segment_length_offsets_must_match);
+    size_t segment_length = reinterpret_cast<TraceFileSegmentHeader*>(
+        segment_prefix + 1)->segment_length;
+    if (segment_length > std::numeric_limits<size_t>::max() - header_length) {
+      LOG(ERROR) << "Invalid segment length " << segment_length << ".";
+      return false;
     }
 
-    if (::fread(buffer.get(), segment_header.segment_length, 1,
-                trace_file.get()) != 1) {
+    if (!window.GetRange(next_segment, header_length + segment_length,
+                         &data)) {
+      return false;
+    }
+    if (data == NULL) {
       LOG(ERROR) << "Failed to read segment.";
       return false;
     }
+    segment_prefix = reinterpret_cast<RecordPrefix*>(data);
 
-    if (!ConsumeSegmentEvents(*file_header,
-                              segment_header,
-                              buffer.get(),
-                              segment_header.segment_length)) {
+    if (!ConsumeSegmentRecord(file_header, segment_prefix, segment_length))
       return false;
-    }
 
-    next_segment = AlignUp64(
-        next_segment + sizeof(segment_prefix) + sizeof(segment_header) +
-            segment_header.segment_length,
-        file_header->block_size);
+    next_segment = AlignUp64(next_segment + header_length + segment_length,
+                             file_header.block_size);
+  }
+
+  return true;
+}
+
+bool ParseEngineRpc::ConsumeSegmentRecord(const TraceFileHeader& file_header,
+                                          RecordPrefix* segment_prefix,
+                                          size_t segment_length) {
+  DCHECK(segment_prefix != NULL);
+
+  if (segment_prefix->type == TraceFileSegmentHeader::kTypeId) {
+    TraceFileSegmentHeader* segment_header =
+        reinterpret_cast<TraceFileSegmentHeader*>(segment_prefix + 1);
+    return ConsumeSegmentEvents(file_header,
+                                *segment_header,
+                                reinterpret_cast<uint8*>(segment_header + 1),
+                                segment_length);
+  }
+
+  TraceFileCompressedSegmentHeader* compressed_header =
+      reinterpret_cast<TraceFileCompressedSegmentHeader*>(segment_prefix + 1);
+  return ConsumeCompressedSegmentEvents(
+      file_header,
+      *compressed_header,
+      reinterpret_cast<uint8*>(compressed_header + 1));
+}
+
+bool ParseEngineRpc::IsSegmentPrefixValid(const RecordPrefix& segment_prefix) {
+  if (segment_prefix.version.hi != TRACE_VERSION_HI ||
+      segment_prefix.version.lo != TRACE_VERSION_LO ||
+      !((segment_prefix.type == TraceFileSegmentHeader::kTypeId &&
+         segment_prefix.size == sizeof(TraceFileSegmentHeader)) ||
+        (segment_prefix.type == TraceFileCompressedSegmentHeader::kTypeId &&
+         segment_prefix.size == sizeof(TraceFileCompressedSegmentHeader)))) {
+    LOG(ERROR) << "Unrecognized record prefix for segment header.";
+    return false;
   }
 
   return true;
 }
 
+bool ParseEngineRpc::ConsumeCompressedSegmentEvents(
+    const TraceFileHeader& file_header,
+    const TraceFileCompressedSegmentHeader& compressed_header,
+    const uint8* compressed_data) {
+  // The segment was compressed by the call trace service. We decompress it
+  // and carry on as though it was stored as is.
+  if (compressed_header.compression !=
+          TraceFileCompressedSegmentHeader::kZlibCompression) {
+    LOG(ERROR) << "Unrecognized segment compression "
+               << compressed_header.compression << ".";
+    return false;
+  }
+
+  decompressed_buffer_.resize(compressed_header.uncompressed_length);
+  if (!DecompressSegment(compressed_data,
+                         compressed_header.segment_length,
+                         decompressed_buffer_.empty() ?
+                             NULL : &decompressed_buffer_[0],
+                         decompressed_buffer_.size())) {
+    return false;
+  }
+
+  TraceFileSegmentHeader segment_header = {};
+  segment_header.thread_id = compressed_header.thread_id;
+  segment_header.segment_length = compressed_header.uncompressed_length;
+  return ConsumeSegmentEvents(file_header,
+                              segment_header,
+                              decompressed_buffer_.empty() ?
+                                  NULL : &decompressed_buffer_[0],
+                              decompressed_buffer_.size());
+}
+
 bool ParseEngineRpc::ConsumeSegmentEvents(
     const TraceFileHeader& file_header,
     const TraceFileSegmentHeader& segment_header,
@@ -277,10 +869,9 @@ bool ParseEngineRpc::ConsumeSegmentEvents(
 
     // The TimeStamp is interpreted as a FILETIME, so we convert the timer
     // value to that.
-    trace::common::TscToFileTime(
-        file_header.clock_info,
-        prefix->timestamp,
-        reinterpret_cast<FILETIME*>(&event_record.Header.TimeStamp));
+    TscToFileTime(file_header,
+                  prefix->timestamp,
+                  reinterpret_cast<FILETIME*>(&event_record.Header.TimeStamp));
 
     event_record.MofData = prefix + 1;
     event_record.MofLength = prefix->size;
@@ -294,6 +885,11 @@ bool ParseEngineRpc::ConsumeSegmentEvents(
     }
   }
 
+  // Function entry batches don't span segments.
+  FlushFunctionEntryBatch();
+  if (error_occurred())
+    return false;
+
   return true;
 }
 
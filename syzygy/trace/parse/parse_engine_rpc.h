@@ -17,6 +17,10 @@
 #ifndef SYZYGY_TRACE_PARSE_PARSE_ENGINE_RPC_H_
 #define SYZYGY_TRACE_PARSE_PARSE_ENGINE_RPC_H_
 
+#include <stdio.h>
+
+#include <vector>
+
 #include "base/time.h"
 #include "base/files/file_path.h"
 #include "syzygy/trace/parse/parse_engine.h"
@@ -27,7 +31,25 @@ namespace parser {
 
 class ParseEngineRpc : public ParseEngine {
  public:
+  // The ways in which the body of a trace file can be read.
+  enum ReadMode {
+    // Each segment is read into an intermediate buffer using stdio.
+    kBufferedRead,
+    // The trace file is mapped into memory a window at a time, and events are
+    // dispatched straight out of the mapped view. This avoids copying every
+    // segment and is considerably faster on large trace files.
+    kMappedRead,
+  };
+
+  // The size of the window of the trace file that is mapped at once in
+  // kMappedRead mode. Windows are grown as necessary to contain a whole
+  // segment.
+  static const size_t kMappedWindowSize = 64 * 1024 * 1024;
+
+  // Constructs a parse engine that uses kMappedRead mode.
   ParseEngineRpc();
+  // Constructs a parse engine that uses the given @p read_mode.
+  explicit ParseEngineRpc(ReadMode read_mode);
   virtual ~ParseEngineRpc();
 
   // @name ParseEngine implementation
@@ -38,6 +60,13 @@ class ParseEngineRpc : public ParseEngine {
       const base::FilePath& trace_file_path) OVERRIDE;
   virtual bool ConsumeAllEvents() OVERRIDE;
   virtual bool CloseAllTraceFiles() OVERRIDE;
+  virtual bool IsRecognizedTraceStream(
+      const TraceFileHeader& file_header) OVERRIDE;
+  virtual bool ConsumeTraceStreamHeader(
+      const TraceFileHeader& file_header) OVERRIDE;
+  virtual bool ConsumeTraceStreamRecord(const TraceFileHeader& file_header,
+                                        uint8* record,
+                                        size_t length) OVERRIDE;
   // @}
 
  private:
@@ -54,6 +83,95 @@ class ParseEngineRpc : public ParseEngine {
   // @return true on success
   bool ConsumeTraceFile(const base::FilePath& trace_file_path);
 
+  // Registers the executable of the process described by a trace file header
+  // and dispatches the start of that process.
+  //
+  // @param file_header the header information describing the trace file. Its
+  //     variable length part must follow it.
+  // @return true on success.
+  bool ConsumeTraceFileHeader(const TraceFileHeader& file_header);
+
+  // @name Segment consumers for each of the read modes. These dispatch all of
+  //     the segments in a trace file, starting with the one at offset
+  //     @p first_segment, or only those at @p segment_offsets if it is not
+  //     NULL.
+  // @{
+  bool ConsumeBufferedSegments(FILE* trace_file,
+                               const TraceFileHeader& file_header,
+                               uint64 first_segment,
+                               const std::vector<uint64>* segment_offsets);
+  bool ConsumeMappedSegments(const base::FilePath& trace_file_path,
+                             const TraceFileHeader& file_header,
+                             uint64 first_segment,
+                             const std::vector<uint64>* segment_offsets);
+  // @}
+
+  // Reads the index of a trace file, if it has a valid one.
+  //
+  // @param trace_file the trace file.
+  // @param file_header the header information describing the trace file.
+  // @param first_segment the offset of the first segment of the trace file.
+  // @param entries receives the entries of the index.
+  // @return true if the trace file has a valid index, false otherwise.
+  static bool ReadTraceFileIndex(FILE* trace_file,
+                                 const TraceFileHeader& file_header,
+                                 uint64 first_segment,
+                                 std::vector<TraceFileIndexEntry>* entries);
+
+  // Determines whether an indexed segment needs to be consumed given the
+  // event filter. This is the case if it may hold events that pass the
+  // filter, or holds events that aren't subject to it.
+  //
+  // @param file_header the header information describing the trace file.
+  // @param entry the index entry describing the segment.
+  // @return true if the segment needs to be consumed.
+  bool IsSegmentOfInterest(const TraceFileHeader& file_header,
+                           const TraceFileIndexEntry& entry) const;
+
+  // Converts a TSC value of the trace file being consumed to a file time.
+  // This uses the clock timeline once the file has provided clock samples,
+  // which places the events of all trace files on a common timeline, and
+  // falls back to the clock information of the file otherwise.
+  //
+  // @param file_header the header information describing the trace file.
+  // @param tsc the TSC value to convert.
+  // @param file_time receives the file time.
+  // @return true on success.
+  bool TscToFileTime(const TraceFileHeader& file_header,
+                     uint64 tsc,
+                     FILETIME* file_time) const;
+
+  // Validates the record prefix of a segment header.
+  // @param segment_prefix the prefix to validate.
+  // @returns true if it describes a regular or a compressed segment header.
+  static bool IsSegmentPrefixValid(const RecordPrefix& segment_prefix);
+
+  // Dispatches the events of a regular or compressed segment, laid out in
+  // memory as it is in a trace file.
+  //
+  // @param file_header the header information describing the trace file.
+  // @param segment_prefix the prefix of the segment header, which has been
+  //     validated by IsSegmentPrefixValid(). The segment header and content
+  //     follow it.
+  // @param segment_length the length of the segment content, as per the
+  //     segment header.
+  // @return true on success.
+  bool ConsumeSegmentRecord(const TraceFileHeader& file_header,
+                            RecordPrefix* segment_prefix,
+                            size_t segment_length);
+
+  // Decompresses a compressed segment and dispatches the events it contains.
+  //
+  // @param file_header the header information describing the trace file.
+  // @param compressed_header the header of the compressed segment.
+  // @param compressed_data the compressed content of the segment, of length
+  //     compressed_header.segment_length.
+  // @return true on success.
+  bool ConsumeCompressedSegmentEvents(
+      const TraceFileHeader& file_header,
+      const TraceFileCompressedSegmentHeader& compressed_header,
+      const uint8* compressed_data);
+
   // Dispactches all of the events in the given segment buffer.
   //
   // @param file_header the header information describing the trace file.
@@ -69,6 +187,13 @@ class ParseEngineRpc : public ParseEngine {
   // The set of trace files to consume when ConsumeAllEvents() is called.
   TraceFileSet trace_file_set_;
 
+  // The way in which the trace files are read.
+  ReadMode read_mode_;
+
+  // Receives the content of compressed segments. This is reused across
+  // segments to avoid reallocating it for each of them.
+  std::vector<uint8> decompressed_buffer_;
+
   DISALLOW_COPY_AND_ASSIGN(ParseEngineRpc);
 };
 
@@ -18,6 +18,7 @@
 
 #include <list>
 #include <map>
+#include <set>
 
 #include "base/environment.h"
 #include "base/file_util.h"
@@ -38,16 +39,21 @@
 #include "syzygy/trace/common/unittest_util.h"
 #include "syzygy/trace/parse/parser.h"
 #include "syzygy/trace/service/process_info.h"
+#include "syzygy/trace/service/trace_file_writer.h"
 
 namespace trace {
 namespace service {
 namespace {
 
+using ::trace::parser::ParseEngineRpc;
 using ::trace::parser::Parser;
 using ::trace::parser::ParseEventHandlerImpl;
 
 static const uint32 kConstantInThisModule = 0;
 
+// The number of function entries in a synthetic trace file.
+static const size_t kNumSyntheticEntries = 4;
+
 enum CallEntryType {
   kCallEntry,
   kCallExit,
@@ -238,6 +244,9 @@ typedef BOOL (WINAPI *DllMainFunc)(HMODULE module,
 
 extern const DllMainFunc IndirectThunkDllMain;
 
+void IndirectFunctionA();
+void IndirectFunctionB();
+
 // We run events through a file session to assert that
 // the content comes through.
 class ParseEngineRpcTest: public testing::PELibUnitTest {
@@ -282,13 +291,159 @@ class ParseEngineRpcTest: public testing::PELibUnitTest {
     service_.Stop();
   }
 
+  // Gets the time at which an event was recorded in a synthetic trace file.
+  // @param clock_info the clock information of the trace file.
+  // @param seconds the number of seconds from the start of the trace file.
+  // @returns the time of the event.
+  static base::Time GetSyntheticTime(
+      const trace::common::ClockInfo& clock_info, size_t seconds) {
+    FILETIME file_time = {};
+    EXPECT_TRUE(trace::common::TscToFileTime(
+        clock_info,
+        clock_info.tsc_reference + seconds * clock_info.tsc_info.frequency,
+        &file_time));
+    return base::Time::FromFileTime(file_time);
+  }
+
+  // Writes a trace file, without involving the call trace service. This holds
+  // a process attach event at its start, followed by kNumSyntheticEntries
+  // function entries one second apart, alternating between IndirectFunctionA
+  // and IndirectFunctionB. Each event is in its own segment.
+  // @param write_index true if the trace file is to be indexed.
+  // @param clock_info receives the clock information of the trace file.
+  void WriteSyntheticTraceFile(bool write_index,
+                               trace::common::ClockInfo* clock_info) {
+    ASSERT_TRUE(clock_info != NULL);
+
+    ProcessInfo process_info;
+    ASSERT_TRUE(process_info.Initialize(::GetCurrentProcessId()));
+
+    TraceFileWriter writer;
+    writer.set_write_index(write_index);
+    ASSERT_TRUE(writer.Open(temp_dir_.AppendASCII("trace-synthetic.bin")));
+    trace::common::GetClockInfo(clock_info);
+    ASSERT_LT(0u, clock_info->tsc_info.frequency);
+    ASSERT_TRUE(writer.WriteHeader(process_info));
+
+    TraceModuleData module_data = {
+        reinterpret_cast<ModuleAddr>(0x10000000),
+        0x1000,
+        0x22222222,
+        0x33333333,
+        L"module.dll",
+        L"module.dll" };
+    ASSERT_NO_FATAL_FAILURE(testing::WriteRecord(
+        clock_info->tsc_reference, TRACE_PROCESS_ATTACH_EVENT, &module_data,
+        sizeof(module_data), &writer));
+
+    for (size_t i = 0; i < kNumSyntheticEntries; ++i) {
+      TraceEnterEventData enter_data = {};
+      enter_data.function = i % 2 == 0 ?
+          reinterpret_cast<FuncAddr>(&IndirectFunctionA) :
+          reinterpret_cast<FuncAddr>(&IndirectFunctionB);
+      uint64 timestamp = clock_info->tsc_reference +
+          (i + 1) * clock_info->tsc_info.frequency;
+      ASSERT_NO_FATAL_FAILURE(testing::WriteRecord(
+          timestamp, TRACE_ENTER_EVENT, &enter_data, sizeof(enter_data),
+          &writer));
+    }
+
+    ASSERT_TRUE(writer.Close());
+  }
+
+  // Consumes the synthetic trace file with the given filter.
+  void ConsumeSyntheticTraceFile(ParseEngineRpc::ReadMode read_mode,
+                                 base::Time begin_time,
+                                 base::Time end_time,
+                                 const std::set<DWORD>& thread_ids) {
+    TestParseEventHandler consumer;
+    Parser parser;
+    if (read_mode != ParseEngineRpc::kMappedRead)
+      parser.AddParseEngine(new ParseEngineRpc(read_mode));
+    ASSERT_TRUE(parser.Init(&consumer));
+    parser.SetTimeRange(begin_time, end_time);
+    parser.SetThreadFilter(thread_ids);
+    ASSERT_TRUE(parser.OpenTraceFile(
+        temp_dir_.AppendASCII("trace-synthetic.bin")));
+    ASSERT_TRUE(parser.Consume());
+
+    entered_addresses_.clear();
+    module_events_.clear();
+    consumer.GetEnteredAddresses(&entered_addresses_);
+    consumer.GetModuleEvents(&module_events_);
+  }
+
+  void CheckTimeRange(bool write_index) {
+    trace::common::ClockInfo clock_info = {};
+    ASSERT_NO_FATAL_FAILURE(WriteSyntheticTraceFile(write_index, &clock_info));
+
+    // Only the entries at seconds 2 and 3 are in range, but the process attach
+    // event is dispatched regardless.
+    base::TimeDelta half_second = base::TimeDelta::FromMilliseconds(500);
+    base::Time begin_time = GetSyntheticTime(clock_info, 2) - half_second;
+    base::Time end_time = GetSyntheticTime(clock_info, 4) - half_second;
+    ParseEngineRpc::ReadMode read_modes[] = {
+        ParseEngineRpc::kBufferedRead, ParseEngineRpc::kMappedRead };
+    for (size_t i = 0; i < arraysize(read_modes); ++i) {
+      ASSERT_NO_FATAL_FAILURE(ConsumeSyntheticTraceFile(
+          read_modes[i], begin_time, end_time, std::set<DWORD>()));
+      EXPECT_EQ(2u, entered_addresses_.size());
+      EXPECT_EQ(1u, entered_addresses_.count(IndirectFunctionA));
+      EXPECT_EQ(1u, entered_addresses_.count(IndirectFunctionB));
+      EXPECT_EQ(1u, module_events_.size());
+    }
+
+    // The bounds may be left open.
+    ASSERT_NO_FATAL_FAILURE(ConsumeSyntheticTraceFile(
+        ParseEngineRpc::kMappedRead, begin_time, base::Time(),
+        std::set<DWORD>()));
+    EXPECT_EQ(3u, entered_addresses_.size());
+    ASSERT_NO_FATAL_FAILURE(ConsumeSyntheticTraceFile(
+        ParseEngineRpc::kMappedRead, base::Time(), end_time,
+        std::set<DWORD>()));
+    EXPECT_EQ(3u, entered_addresses_.size());
+  }
+
+  void CheckThreadFilter(bool write_index) {
+    trace::common::ClockInfo clock_info = {};
+    ASSERT_NO_FATAL_FAILURE(WriteSyntheticTraceFile(write_index, &clock_info));
+
+    std::set<DWORD> thread_ids;
+    thread_ids.insert(::GetCurrentThreadId());
+    ASSERT_NO_FATAL_FAILURE(ConsumeSyntheticTraceFile(
+        ParseEngineRpc::kMappedRead, base::Time(), base::Time(), thread_ids));
+    EXPECT_EQ(kNumSyntheticEntries, entered_addresses_.size());
+    EXPECT_EQ(1u, module_events_.size());
+
+    // None of the entries were reported by another thread, but the process
+    // attach event is dispatched regardless.
+    thread_ids.clear();
+    thread_ids.insert(::GetCurrentThreadId() + 1);
+    ParseEngineRpc::ReadMode read_modes[] = {
+        ParseEngineRpc::kBufferedRead, ParseEngineRpc::kMappedRead };
+    for (size_t i = 0; i < arraysize(read_modes); ++i) {
+      ASSERT_NO_FATAL_FAILURE(ConsumeSyntheticTraceFile(
+          read_modes[i], base::Time(), base::Time(), thread_ids));
+      EXPECT_TRUE(entered_addresses_.empty());
+      EXPECT_EQ(1u, module_events_.size());
+    }
+  }
+
   void ConsumeEventsFromTempSession() {
+    ASSERT_NO_FATAL_FAILURE(
+        ConsumeEventsFromTempSession(ParseEngineRpc::kMappedRead));
+  }
+
+  void ConsumeEventsFromTempSession(ParseEngineRpc::ReadMode read_mode) {
     // Stop the call trace service to ensure all buffers have been flushed.
     ASSERT_NO_FATAL_FAILURE(StopCallTraceService());
 
     // Parse the call trace log.
     TestParseEventHandler consumer;
     Parser parser;
+    // The parser uses the mapped read mode by default.
+    if (read_mode != ParseEngineRpc::kMappedRead)
+      parser.AddParseEngine(new ParseEngineRpc(read_mode));
     ASSERT_TRUE(parser.Init(&consumer));
     base::FilePath trace_file_path;
     ASSERT_TRUE(FindTraceFile(&trace_file_path));
@@ -533,6 +688,27 @@ TEST_F(ParseEngineRpcTest, SingleThread) {
   ASSERT_EQ(2, entered_addresses_.count(IndirectDllMain));
 }
 
+TEST_F(ParseEngineRpcTest, SingleThreadBufferedRead) {
+  ASSERT_NO_FATAL_FAILURE(StartCallTraceService());
+
+  ASSERT_NO_FATAL_FAILURE(LoadCallTraceDll());
+
+  IndirectThunkDllMain(module_, DLL_PROCESS_ATTACH, this);
+  IndirectThunkA();
+  IndirectThunkA();
+  IndirectThunkA();
+  IndirectThunkDllMain(module_, DLL_PROCESS_DETACH, this);
+
+  ASSERT_NO_FATAL_FAILURE(UnloadCallTraceDll());
+
+  ASSERT_NO_FATAL_FAILURE(
+      ConsumeEventsFromTempSession(ParseEngineRpc::kBufferedRead));
+
+  ASSERT_EQ(5, entered_addresses_.size());
+  ASSERT_EQ(3, entered_addresses_.count(IndirectFunctionA));
+  ASSERT_EQ(2, entered_addresses_.count(IndirectDllMain));
+}
+
 TEST_F(ParseEngineRpcTest, MultiThreadWithDetach) {
   ASSERT_NO_FATAL_FAILURE(StartCallTraceService());
 
@@ -801,5 +977,87 @@ TEST_F(ParseEngineRpcTest, MultiThreadWithStopCallTrace) {
   ASSERT_EQ(77, entered_addresses_.count(IndirectFunctionB));
 }
 
+TEST_F(ParseEngineRpcTest, TimeRangeUnindexed) {
+  ASSERT_NO_FATAL_FAILURE(CheckTimeRange(false));
+}
+
+TEST_F(ParseEngineRpcTest, TimeRangeIndexed) {
+  ASSERT_NO_FATAL_FAILURE(CheckTimeRange(true));
+}
+
+TEST_F(ParseEngineRpcTest, ThreadFilterUnindexed) {
+  ASSERT_NO_FATAL_FAILURE(CheckThreadFilter(false));
+}
+
+TEST_F(ParseEngineRpcTest, ThreadFilterIndexed) {
+  ASSERT_NO_FATAL_FAILURE(CheckThreadFilter(true));
+}
+
+TEST_F(ParseEngineRpcTest, ConsumeTraceStream) {
+  ProcessInfo process_info;
+  ASSERT_TRUE(process_info.Initialize(::GetCurrentProcessId()));
+  const size_t kBlockSize = 512;
+  std::vector<uint8> header;
+  ASSERT_TRUE(TraceFileWriter::BuildHeader(process_info, kBlockSize, &header));
+  const TraceFileHeader* file_header =
+      reinterpret_cast<const TraceFileHeader*>(&header[0]);
+
+  TestParseEventHandler consumer;
+  Parser parser;
+  ASSERT_TRUE(parser.Init(&consumer));
+  ASSERT_TRUE(parser.OpenTraceStream(*file_header));
+
+  // The executable is known as soon as the stream is open.
+  trace::parser::AbsoluteAddress64 addr =
+      reinterpret_cast<uint32>(&kConstantInThisModule);
+  const trace::parser::ModuleInformation* module_info =
+      parser.GetModuleInformation(process_info.process_id, addr);
+  ASSERT_TRUE(module_info != NULL);
+  EXPECT_EQ(process_info.exe_base_address, module_info->base_address);
+
+  // Feed the records as a client would hand over its buffers.
+  uint64 timestamp = file_header->clock_info.tsc_reference;
+  TraceModuleData module_data = {
+      reinterpret_cast<ModuleAddr>(0x10000000),
+      0x1000,
+      0x22222222,
+      0x33333333,
+      L"module.dll",
+      L"module.dll" };
+  std::vector<uint8> record;
+  ASSERT_NO_FATAL_FAILURE(testing::BuildRecord(
+      timestamp, TRACE_PROCESS_ATTACH_EVENT, &module_data,
+      sizeof(module_data), kBlockSize, &record));
+  ASSERT_TRUE(parser.ConsumeTraceStreamRecord(*file_header, &record[0],
+                                              record.size()));
+
+  TraceEnterEventData enter_data = {};
+  enter_data.function = reinterpret_cast<FuncAddr>(&IndirectFunctionA);
+  ASSERT_NO_FATAL_FAILURE(testing::BuildRecord(
+      timestamp, TRACE_ENTER_EVENT, &enter_data, sizeof(enter_data),
+      kBlockSize, &record));
+  ASSERT_TRUE(parser.ConsumeTraceStreamRecord(*file_header, &record[0],
+                                              record.size()));
+  ASSERT_TRUE(parser.ConsumeTraceStreamRecord(*file_header, &record[0],
+                                              record.size()));
+
+  consumer.GetEnteredAddresses(&entered_addresses_);
+  consumer.GetModuleEvents(&module_events_);
+  EXPECT_EQ(2u, entered_addresses_.size());
+  EXPECT_EQ(2u, entered_addresses_.count(IndirectFunctionA));
+  EXPECT_EQ(1u, module_events_.size());
+
+  // An empty segment holds no events, but a truncated one is an error.
+  TraceFileSegmentHeader* segment_header =
+      reinterpret_cast<TraceFileSegmentHeader*>(
+          reinterpret_cast<RecordPrefix*>(&record[0]) + 1);
+  segment_header->segment_length = record.size();
+  EXPECT_FALSE(parser.ConsumeTraceStreamRecord(*file_header, &record[0],
+                                               record.size()));
+  segment_header->segment_length = 0;
+  EXPECT_TRUE(parser.ConsumeTraceStreamRecord(*file_header, &record[0],
+                                              record.size()));
+}
+
 }  // namespace service
 }  // namespace trace
@@ -26,10 +26,12 @@
 #include "gtest/gtest.h"
 #include "syzygy/common/indexed_frequency_data.h"
 #include "syzygy/trace/parse/parser.h"
+#include "syzygy/trace/protocol/compact_batch.h"
 
 namespace {
 
 using testing::_;
+using trace::parser::FunctionEntryEvent;
 using trace::parser::Parser;
 using trace::parser::ParseEngine;
 using trace::parser::ParseEventHandler;
@@ -46,6 +48,7 @@ class ParseEngineUnitTest
   ParseEngineUnitTest()
       : ParseEngine("Test", true),
         basic_block_frequencies(0),
+        function_entry_batches(0),
         expected_data(NULL) {
     ::memset(&event_record_, 0, sizeof(event_record_));
     set_event_handler(this);
@@ -128,6 +131,25 @@ class ParseEngineUnitTest
     }
   }
 
+  virtual bool WantsFunctionEntryBatches() OVERRIDE {
+    return false;
+  }
+
+  virtual void OnFunctionEntryBatch(DWORD process_id,
+                                    DWORD thread_id,
+                                    const FunctionEntryEvent* events,
+                                    size_t num_events) OVERRIDE {
+    ASSERT_EQ(process_id, kProcessId);
+    ASSERT_EQ(thread_id, kThreadId);
+    ASSERT_TRUE(events != NULL);
+    ASSERT_LT(0u, num_events);
+    for (size_t i = 0; i < num_events; ++i) {
+      EXPECT_TRUE(events[i].function != NULL);
+      function_entries.insert(events[i].function);
+    }
+    ++function_entry_batches;
+  }
+
   virtual void OnProcessAttach(base::Time time,
                                DWORD process_id,
                                DWORD thread_id,
@@ -196,6 +218,26 @@ class ParseEngineUnitTest
                void(base::Time time,
                     DWORD process_id,
                     const TraceSampleData* data));
+  MOCK_METHOD3(OnProfilerCalibration,
+               void(base::Time time,
+                    DWORD process_id,
+                    const TraceProfilerCalibration* data));
+  MOCK_METHOD3(OnSampleStacks,
+               void(base::Time time,
+                    DWORD process_id,
+                    const TraceSampleStacks* data));
+  MOCK_METHOD3(OnClockSample,
+               void(base::Time time,
+                    DWORD process_id,
+                    const TraceClockSample* data));
+  MOCK_METHOD3(OnDataPageTouches,
+               void(base::Time time,
+                    DWORD process_id,
+                    const TraceDataPageTouches* data));
+  MOCK_METHOD3(OnBuffersDropped,
+               void(base::Time time,
+                    DWORD process_id,
+                    const TraceBuffersDropped* data));
 
   static const DWORD kProcessId;
   static const DWORD kThreadId;
@@ -214,6 +256,7 @@ class ParseEngineUnitTest
   ModuleSet thread_attaches;
   ModuleSet thread_detaches;
   size_t basic_block_frequencies;
+  size_t function_entry_batches;
 
   const void* expected_data;
 };
@@ -369,6 +412,46 @@ TEST_F(ParseEngineUnitTest, ModuleInfo) {
   ASSERT_TRUE(*module_info == new_dll_info);
 }
 
+TEST_F(ParseEngineUnitTest, ModuleLookupsAcrossProcesses) {
+  const uint32 kOtherProcessId = kProcessId + 1;
+  ModuleInformation other_dll_info = kDllInfo;
+  other_dll_info.base_address = kExeInfo.base_address;
+  ASSERT_TRUE(AddModuleInformation(kProcessId, kExeInfo));
+  ASSERT_TRUE(AddModuleInformation(kProcessId, kDllInfo));
+  ASSERT_TRUE(AddModuleInformation(kOtherProcessId, other_dll_info));
+
+  // Interleave lookups in both processes, and in both modules of the first.
+  for (size_t i = 0; i < 3; ++i) {
+    const ModuleInformation* module_info =
+        GetModuleInformation(kProcessId, kExeInfo.base_address + i);
+    ASSERT_TRUE(module_info != NULL);
+    EXPECT_TRUE(*module_info == kExeInfo);
+
+    module_info = GetModuleInformation(kOtherProcessId,
+                                       other_dll_info.base_address + i);
+    ASSERT_TRUE(module_info != NULL);
+    EXPECT_TRUE(*module_info == other_dll_info);
+
+    module_info = GetModuleInformation(kProcessId, kDllInfo.base_address + i);
+    ASSERT_TRUE(module_info != NULL);
+    EXPECT_TRUE(*module_info == kDllInfo);
+  }
+
+  // Addresses past the last module of a process aren't in any module.
+  EXPECT_TRUE(GetModuleInformation(
+      kOtherProcessId,
+      other_dll_info.base_address + other_dll_info.module_size) == NULL);
+
+  // Modules loaded after lookups are found as well.
+  ModuleInformation late_dll_info = kDllInfo;
+  late_dll_info.base_address = kDllInfo.base_address + kDllInfo.module_size;
+  ASSERT_TRUE(AddModuleInformation(kOtherProcessId, late_dll_info));
+  const ModuleInformation* module_info =
+      GetModuleInformation(kOtherProcessId, late_dll_info.base_address);
+  ASSERT_TRUE(module_info != NULL);
+  EXPECT_TRUE(*module_info == late_dll_info);
+}
+
 TEST_F(ParseEngineUnitTest, UnhandledEvent) {
   EVENT_TRACE local_record = {};
   ASSERT_FALSE(DispatchEvent(&local_record));
@@ -465,6 +548,106 @@ TEST_F(ParseEngineUnitTest, BatchFunctionEntry) {
   ASSERT_TRUE(error_occurred());
 }
 
+TEST_F(ParseEngineUnitTest, FunctionEntryBatches) {
+  // Route the function entries through the batched callback.
+  batch_function_entries_ = true;
+
+  TraceEnterEventData enter_data = {};
+  enter_data.function = &TestFunc1;
+  TraceExitEventData exit_data = {};
+  exit_data.function = &TestFunc2;
+
+  uint8 raw_data[sizeof(TraceBatchEnterData) +
+                     sizeof(TraceEnterEventData)] = {};
+  TraceBatchEnterData& batch_data =
+     *reinterpret_cast<TraceBatchEnterData*>(&raw_data);
+  batch_data.thread_id = kThreadId;
+  batch_data.num_calls = 2;
+  batch_data.calls[0].function = &TestFunc1;
+  batch_data.calls[1].function = &TestFunc2;
+
+  // Two entries, interrupted by an exit, then more entries from a batch.
+  expected_data = &enter_data;
+  ASSERT_NO_FATAL_FAILURE(
+      DispatchEventData(TRACE_ENTER_EVENT, &enter_data, sizeof(enter_data)));
+  ASSERT_NO_FATAL_FAILURE(
+      DispatchEventData(TRACE_ENTER_EVENT, &enter_data, sizeof(enter_data)));
+  ASSERT_FALSE(error_occurred());
+
+  // Nothing is issued until the run of entries ends.
+  EXPECT_EQ(0u, function_entry_batches);
+  EXPECT_TRUE(function_entries.empty());
+
+  expected_data = &exit_data;
+  ASSERT_NO_FATAL_FAILURE(
+      DispatchEventData(TRACE_EXIT_EVENT, &exit_data, sizeof(exit_data)));
+  ASSERT_FALSE(error_occurred());
+  EXPECT_EQ(1u, function_entry_batches);
+  EXPECT_EQ(2u, function_entries.count(&TestFunc1));
+  EXPECT_EQ(1u, function_exits.count(&TestFunc2));
+
+  expected_data = &enter_data;
+  ASSERT_NO_FATAL_FAILURE(
+      DispatchEventData(TRACE_ENTER_EVENT, &enter_data, sizeof(enter_data)));
+  expected_data = &raw_data;
+  ASSERT_NO_FATAL_FAILURE(
+      DispatchEventData(TRACE_BATCH_ENTER, &raw_data, sizeof(raw_data)));
+  ASSERT_FALSE(error_occurred());
+  EXPECT_EQ(1u, function_entry_batches);
+
+  FlushFunctionEntryBatch();
+  EXPECT_EQ(2u, function_entry_batches);
+  EXPECT_EQ(4u, function_entries.count(&TestFunc1));
+  EXPECT_EQ(1u, function_entries.count(&TestFunc2));
+
+  // Flushing an empty batch is a no-op.
+  FlushFunctionEntryBatch();
+  EXPECT_EQ(2u, function_entry_batches);
+}
+
+TEST_F(ParseEngineUnitTest, BatchFunctionEntryCompact) {
+  batch_function_entries_ = true;
+
+  // Three calls to TestFunc1, coalesced, then one to TestFunc2.
+  std::vector<uint8> raw_data(sizeof(TraceBatchEnterCompactData) +
+                                  2 * kMaxCompactBatchCallSize +
+                                  kCompactBatchRepeatSize);
+  TraceBatchEnterCompactData* event_data =
+      reinterpret_cast<TraceBatchEnterCompactData*>(&raw_data[0]);
+  event_data->thread_id = kThreadId;
+  event_data->num_entries = 3;
+  size_t size = sizeof(*event_data);
+  size += EncodeCompactBatchCall(NULL, &TestFunc1, &raw_data[size]);
+  EncodeCompactBatchRepeat(&raw_data[size]);
+  ASSERT_TRUE(IncrementCompactBatchRepeat(&raw_data[size]));
+  size += kCompactBatchRepeatSize;
+  size += EncodeCompactBatchCall(&TestFunc1, &TestFunc2, &raw_data[size]);
+  raw_data.resize(size);
+
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(TRACE_BATCH_ENTER_COMPACT,
+                                            &raw_data[0],
+                                            raw_data.size()));
+  ASSERT_FALSE(error_occurred());
+  FlushFunctionEntryBatch();
+  EXPECT_EQ(1u, function_entry_batches);
+  EXPECT_EQ(3u, function_entries.count(&TestFunc1));
+  EXPECT_EQ(1u, function_entries.count(&TestFunc2));
+
+  // Check for short event header.
+  ASSERT_NO_FATAL_FAILURE(
+      DispatchEventData(TRACE_BATCH_ENTER_COMPACT,
+                        &raw_data[0],
+                        FIELD_OFFSET(TraceBatchEnterCompactData, num_entries)));
+  ASSERT_TRUE(error_occurred());
+
+  // Check for short event data.
+  set_error_occurred(false);
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(TRACE_BATCH_ENTER_COMPACT,
+                                            &raw_data[0],
+                                            raw_data.size() - 1));
+  ASSERT_TRUE(error_occurred());
+}
+
 TEST_F(ParseEngineUnitTest, ProcessAttachIncomplete) {
   TraceModuleData incomplete(kModuleData);
   incomplete.module_base_addr = NULL;
@@ -638,4 +821,151 @@ TEST_F(ParseEngineUnitTest, SampleData) {
   ASSERT_TRUE(error_occurred());
 }
 
+TEST_F(ParseEngineUnitTest, ProfilerCalibration) {
+  const uint32 kNumProcessors = 4;
+  char buffer[FIELD_OFFSET(TraceProfilerCalibration, tsc_offsets) +
+              kNumProcessors * sizeof(int64)] = {};
+  TraceProfilerCalibration* data =
+      reinterpret_cast<TraceProfilerCalibration*>(buffer);
+
+  data->invocation_overhead_cycles = 120;
+  data->tsc_read_cycles = 24;
+  data->num_processors = kNumProcessors;
+  for (size_t i = 0; i < kNumProcessors; ++i)
+    data->tsc_offsets[i] = i * 10;
+
+  EXPECT_CALL(*this, OnProfilerCalibration(_, kProcessId, data));
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(TRACE_PROFILER_CALIBRATION,
+                                            data,
+                                            sizeof(buffer)));
+  ASSERT_FALSE(error_occurred());
+
+  // Dispatch a malformed record and make sure the parser errors.
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(TRACE_PROFILER_CALIBRATION,
+                                            data,
+                                            sizeof(buffer) - 1));
+  ASSERT_TRUE(error_occurred());
+}
+
+TEST_F(ParseEngineUnitTest, SampleStacks) {
+  const uint32 kNumStacks = 2;
+  const uint32 kNumFrames = 3;
+  char buffer[FIELD_OFFSET(TraceSampleStacks, stacks) +
+              kNumStacks * sizeof(TraceSampleStack) +
+              kNumFrames * sizeof(ModuleAddr)] = {};
+  TraceSampleStacks* data = reinterpret_cast<TraceSampleStacks*>(buffer);
+
+  data->sampling_start_time = 100;
+  data->sampling_end_time = 200;
+  data->sampling_interval = 10;
+  data->num_stacks = kNumStacks;
+  data->num_frames = kNumFrames;
+  data->stacks[0].stack_id = 1;
+  data->stacks[0].count = 4;
+  data->stacks[0].num_frames = kNumFrames;
+  data->stacks[1].stack_id = 0;
+  data->stacks[1].count = 2;
+  data->stacks[1].num_frames = 0;
+  ModuleAddr* frames = reinterpret_cast<ModuleAddr*>(data->stacks + kNumStacks);
+  for (size_t i = 0; i < kNumFrames; ++i)
+    frames[i] = reinterpret_cast<ModuleAddr>(0x10000000 + i * 0x100);
+
+  EXPECT_CALL(*this, OnSampleStacks(_, kProcessId, data));
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(TRACE_SAMPLE_STACKS,
+                                            data,
+                                            sizeof(buffer)));
+  ASSERT_FALSE(error_occurred());
+
+  // Dispatch a truncated record and make sure the parser errors.
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(TRACE_SAMPLE_STACKS,
+                                            data,
+                                            sizeof(buffer) - 1));
+  ASSERT_TRUE(error_occurred());
+  set_error_occurred(false);
+
+  // Dispatch a record whose stacks don't account for all of its frames.
+  data->stacks[0].num_frames = kNumFrames - 1;
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(TRACE_SAMPLE_STACKS,
+                                            data,
+                                            sizeof(buffer)));
+  ASSERT_TRUE(error_occurred());
+}
+
+TEST_F(ParseEngineUnitTest, ClockSample) {
+  TraceClockSample data = {};
+  data.reference.qpc = 1000;
+  data.reference.tsc = 5000;
+  data.sample = data.reference;
+  data.qpc_frequency = 1000;
+
+  EXPECT_CALL(*this, OnClockSample(_, kProcessId, &data));
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(TRACE_CLOCK_SAMPLE,
+                                            &data,
+                                            sizeof(data)));
+  ASSERT_FALSE(error_occurred());
+  EXPECT_EQ(1u, clock_timeline_.num_samples());
+
+  // An unusable sample is dispatched, but doesn't make it to the timeline.
+  data.qpc_frequency = 0;
+  EXPECT_CALL(*this, OnClockSample(_, kProcessId, &data));
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(TRACE_CLOCK_SAMPLE,
+                                            &data,
+                                            sizeof(data)));
+  ASSERT_FALSE(error_occurred());
+  EXPECT_EQ(1u, clock_timeline_.num_samples());
+
+  // Dispatch a truncated record and make sure the parser errors.
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(TRACE_CLOCK_SAMPLE,
+                                            &data,
+                                            sizeof(data) - 1));
+  ASSERT_TRUE(error_occurred());
+}
+
+TEST_F(ParseEngineUnitTest, DataPageTouches) {
+  const uint32 kNumPages = 3;
+  char buffer[FIELD_OFFSET(TraceDataPageTouches, page_rvas) +
+              kNumPages * sizeof(uint32)] = {};
+  TraceDataPageTouches* data = reinterpret_cast<TraceDataPageTouches*>(buffer);
+
+  data->module_base_addr = reinterpret_cast<ModuleAddr>(0x01000000);
+  data->module_size = 32 * 1024 * 1024;
+  data->module_checksum = 0xDEADF00D;
+  data->module_time_date_stamp = 0x12345678;
+  data->page_size = 4096;
+  data->num_pages = kNumPages;
+  data->page_rvas[0] = 0x3000;
+  data->page_rvas[1] = 0x1000;
+  data->page_rvas[2] = 0x2000;
+
+  EXPECT_CALL(*this, OnDataPageTouches(_, kProcessId, data));
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(TRACE_DATA_PAGE_TOUCHES,
+                                            data,
+                                            sizeof(buffer)));
+  ASSERT_FALSE(error_occurred());
+
+  // Dispatch a truncated record and make sure the parser errors.
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(TRACE_DATA_PAGE_TOUCHES,
+                                            data,
+                                            sizeof(buffer) - 1));
+  ASSERT_TRUE(error_occurred());
+}
+
+TEST_F(ParseEngineUnitTest, BuffersDropped) {
+  TraceBuffersDropped data = {};
+  data.num_buffers = 3;
+  data.num_bytes = 3 * 8192;
+
+  EXPECT_CALL(*this, OnBuffersDropped(_, kProcessId, &data));
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(TRACE_BUFFERS_DROPPED,
+                                            &data,
+                                            sizeof(data)));
+  ASSERT_FALSE(error_occurred());
+
+  // Dispatch a truncated record and make sure the parser errors.
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(TRACE_BUFFERS_DROPPED,
+                                            &data,
+                                            sizeof(data) - 1));
+  ASSERT_TRUE(error_occurred());
+}
+
 }  // namespace
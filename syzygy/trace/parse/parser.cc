@@ -18,11 +18,54 @@
 
 #include "base/logging.h"
 #include "sawbuck/common/buffer_parser.h"
+#include "syzygy/common/stage_profiler.h"
 #include "syzygy/trace/parse/parse_engine_rpc.h"
 
 namespace trace {
 namespace parser {
 
+EventFilter::EventFilter() {
+}
+
+bool EventFilter::IsEmpty() const {
+  return begin_time.is_null() && end_time.is_null() && thread_ids.empty();
+}
+
+bool EventFilter::AppliesTo(TraceEventType type) {
+  switch (type) {
+    case TRACE_PROCESS_ENDED:
+    case TRACE_PROCESS_ATTACH_EVENT:
+    case TRACE_PROCESS_DETACH_EVENT:
+    case TRACE_THREAD_ATTACH_EVENT:
+    case TRACE_THREAD_DETACH_EVENT:
+    case TRACE_MODULE_EVENT:
+    case TRACE_DYNAMIC_SYMBOL:
+    case TRACE_PROFILER_CALIBRATION:
+      return false;
+
+    default:
+      return true;
+  }
+}
+
+bool EventFilter::Matches(base::Time time, DWORD thread_id) const {
+  return MayMatch(time, time, thread_id);
+}
+
+bool EventFilter::MayMatch(base::Time first_time,
+                           base::Time last_time,
+                           DWORD thread_id) const {
+  DCHECK(first_time <= last_time);
+
+  if (!begin_time.is_null() && last_time < begin_time)
+    return false;
+  if (!end_time.is_null() && first_time >= end_time)
+    return false;
+  if (!thread_ids.empty() && thread_ids.count(thread_id) == 0)
+    return false;
+  return true;
+}
+
 Parser::Parser() : active_parse_engine_(NULL) {
 }
 
@@ -87,13 +130,49 @@ bool Parser::OpenTraceFile(const base::FilePath& trace_file_path) {
 }
 
 bool Parser::Consume() {
+  common::ScopedStageTimer timer("Parser::Consume");
+
   if (active_parse_engine_ == NULL) {
     LOG(ERROR) << "No open trace files to consume.";
     return false;
   }
+  active_parse_engine_->set_event_filter(event_filter_);
   return active_parse_engine_->ConsumeAllEvents();
 }
 
+bool Parser::OpenTraceStream(const TraceFileHeader& file_header) {
+  if (active_parse_engine_ == NULL && !SetActiveParseEngine(file_header))
+    return false;
+
+  DCHECK(active_parse_engine_ != NULL);
+  return active_parse_engine_->ConsumeTraceStreamHeader(file_header);
+}
+
+bool Parser::ConsumeTraceStreamRecord(const TraceFileHeader& file_header,
+                                      uint8* record,
+                                      size_t length) {
+  DCHECK(record != NULL);
+
+  if (active_parse_engine_ == NULL) {
+    LOG(ERROR) << "No open trace streams to consume.";
+    return false;
+  }
+  active_parse_engine_->set_event_filter(event_filter_);
+  return active_parse_engine_->ConsumeTraceStreamRecord(file_header, record,
+                                                        length);
+}
+
+void Parser::SetTimeRange(base::Time begin_time, base::Time end_time) {
+  DCHECK(begin_time.is_null() || end_time.is_null() ||
+         begin_time <= end_time);
+  event_filter_.begin_time = begin_time;
+  event_filter_.end_time = end_time;
+}
+
+void Parser::SetThreadFilter(const std::set<DWORD>& thread_ids) {
+  event_filter_.thread_ids = thread_ids;
+}
+
 const ModuleInformation* Parser::GetModuleInformation(
     uint32 process_id, AbsoluteAddress64 addr) const {
   DCHECK(active_parse_engine_ != NULL);
@@ -130,6 +209,25 @@ bool Parser::SetActiveParseEngine(const base::FilePath& trace_file_path) {
   return false;
 }
 
+bool Parser::SetActiveParseEngine(const TraceFileHeader& file_header) {
+  DCHECK(active_parse_engine_ == NULL);
+
+  ParseEngineIter it = parse_engine_set_.begin();
+  for (; it != parse_engine_set_.end(); ++it) {
+    ParseEngine* engine = *it;
+    if (engine->IsRecognizedTraceStream(file_header)) {
+      LOG(INFO) << "Using " << engine->name() << " Call-Trace Parser.";
+      active_parse_engine_ = engine;
+      return true;
+    }
+  }
+
+  LOG(ERROR) << "Failed to find a parse engine for the trace stream of "
+             << "process " << file_header.process_id << ".";
+
+  return false;
+}
+
 void ParseEventHandlerImpl::OnProcessStarted(base::Time time,
                                              DWORD process_id,
                                              const TraceSystemInfo* data) {
@@ -159,6 +257,17 @@ void ParseEventHandlerImpl::OnBatchFunctionEntry(
     const TraceBatchEnterData* data) {
 }
 
+bool ParseEventHandlerImpl::WantsFunctionEntryBatches() {
+  return false;
+}
+
+void ParseEventHandlerImpl::OnFunctionEntryBatch(
+    DWORD process_id,
+    DWORD thread_id,
+    const FunctionEntryEvent* events,
+    size_t num_events) {
+}
+
 void ParseEventHandlerImpl::OnProcessAttach(
     base::Time time,
     DWORD process_id,
@@ -217,5 +326,27 @@ void ParseEventHandlerImpl::OnSampleData(
     base::Time Time, DWORD process_id, const TraceSampleData* data) {
 }
 
+void ParseEventHandlerImpl::OnProfilerCalibration(
+    base::Time time,
+    DWORD process_id,
+    const TraceProfilerCalibration* data) {
+}
+
+void ParseEventHandlerImpl::OnSampleStacks(
+    base::Time time, DWORD process_id, const TraceSampleStacks* data) {
+}
+
+void ParseEventHandlerImpl::OnClockSample(
+    base::Time time, DWORD process_id, const TraceClockSample* data) {
+}
+
+void ParseEventHandlerImpl::OnDataPageTouches(
+    base::Time time, DWORD process_id, const TraceDataPageTouches* data) {
+}
+
+void ParseEventHandlerImpl::OnBuffersDropped(
+    base::Time time, DWORD process_id, const TraceBuffersDropped* data) {
+}
+
 }  // namespace parser
 }  // namespace trace
@@ -18,6 +18,7 @@
 #define SYZYGY_TRACE_PARSE_PARSER_H_
 
 #include <list>
+#include <set>
 
 #include "base/string_piece.h"
 #include "base/time.h"
@@ -58,6 +59,44 @@ typedef core::AddressSpace<AbsoluteAddress64,
                            Size64,
                            AnnotatedModuleInformation> ModuleSpace;
 
+// Restricts the events that a parse session dispatches to its event handler,
+// by time and by the thread reporting them. Events that maintain the parse
+// engine's view of the processes and their modules always pass, so that the
+// events that do pass can still be attributed to modules.
+struct EventFilter {
+  EventFilter();
+
+  // @returns true if the filter lets every event pass.
+  bool IsEmpty() const;
+
+  // @param type the type of an event.
+  // @returns true if events of @p type are subject to the filter.
+  static bool AppliesTo(TraceEventType type);
+
+  // @param time the time of an event subject to the filter.
+  // @param thread_id the thread that reported the event.
+  // @returns true if the event passes the filter.
+  bool Matches(base::Time time, DWORD thread_id) const;
+
+  // @param first_time the time of the earliest of a run of events.
+  // @param last_time the time of the latest of a run of events.
+  // @param thread_id the thread that reported the events.
+  // @returns true if any event of the run may pass the filter.
+  bool MayMatch(base::Time first_time,
+                base::Time last_time,
+                DWORD thread_id) const;
+
+  // Events from before this time don't pass. A null time sets no bound.
+  base::Time begin_time;
+
+  // Events from this time on don't pass. A null time sets no bound.
+  base::Time end_time;
+
+  // Only events reported by these threads pass. An empty set lets events from
+  // all threads pass.
+  std::set<DWORD> thread_ids;
+};
+
 // Forward declarations.
 class ParseEngine;
 class ParseEventHandler;
@@ -97,6 +136,42 @@ class Parser {
   // Consume all events across all currently open trace files.
   bool Consume();
 
+  // Adds an in-memory trace stream to the parse session, and dispatches the
+  // start of the process it describes. This can be called multiple times for
+  // different streams, whose records may then be consumed in any order. The
+  // type of parser used is established based on the first stream opened. It
+  // is an error to mix streams and trace files of different type in a single
+  // parse session.
+  // @param file_header The header of the stream, as it would be written to
+  //     a trace file. This must remain valid while records of the stream are
+  //     being consumed.
+  // @returns true on success.
+  bool OpenTraceStream(const TraceFileHeader& file_header);
+
+  // Consumes the events in a segment record of an open trace stream. The
+  // event filter applies to these, as it does to Consume.
+  // @param file_header The header of the stream the record belongs to.
+  // @param record The record, starting with its RecordPrefix.
+  // @param length The maximum length of the record.
+  // @returns true on success.
+  bool ConsumeTraceStreamRecord(const TraceFileHeader& file_header,
+                                uint8* record,
+                                size_t length);
+
+  // Restricts subsequent calls to Consume to the events recorded in the time
+  // range [@p begin_time, @p end_time). Either bound may be null, in which
+  // case it is open. Trace files that carry an index are only read where they
+  // may hold such events.
+  void SetTimeRange(base::Time begin_time, base::Time end_time);
+
+  // Restricts subsequent calls to Consume to the events reported by the given
+  // threads. An empty set lifts the restriction. Trace files that carry an
+  // index are only read where they may hold such events.
+  void SetThreadFilter(const std::set<DWORD>& thread_ids);
+
+  // @returns the filter applied to the events that are consumed.
+  const EventFilter& event_filter() const { return event_filter_; }
+
   // Given an address and a process id, returns the module in memory at that
   // address. Returns NULL if no such module exists.
   const ModuleInformation* GetModuleInformation(uint32 process_id,
@@ -113,6 +188,10 @@ class Parser {
   // recognizes the given trace file.
   bool SetActiveParseEngine(const base::FilePath& trace_file_path);
 
+  // Sets the currently active parse engine to the first engine that
+  // recognizes the given trace stream.
+  bool SetActiveParseEngine(const TraceFileHeader& file_header);
+
   // The set of parse engines available to consume and dispatch the events
   // contained in a set of trace files.
   ParseEngineSet parse_engine_set_;
@@ -121,9 +200,19 @@ class Parser {
   // will be set based on the first trace file that gets opened.
   ParseEngine* active_parse_engine_;
 
+  // The filter applied to the events that are consumed.
+  EventFilter event_filter_;
+
   DISALLOW_COPY_AND_ASSIGN(Parser);
 };
 
+// A single function entry event, as issued in runs to
+// ParseEventHandler::OnFunctionEntryBatch.
+struct FunctionEntryEvent {
+  base::Time time;
+  FuncAddr function;
+};
+
 // Implemented by clients of Parser to receive trace event notifications.
 class ParseEventHandler {
  public:
@@ -156,6 +245,25 @@ class ParseEventHandler {
                                     DWORD thread_id,
                                     const TraceBatchEnterData* data) = 0;
 
+  // Returns true if the handler wants to receive function entry events in
+  // runs through OnFunctionEntryBatch, in which case OnFunctionEntry and
+  // OnBatchFunctionEntry are never issued. This is queried once, when the
+  // handler is handed to the parser.
+  virtual bool WantsFunctionEntryBatches() = 0;
+
+  // Issued for runs of function entry events. Each run holds the consecutive
+  // function entry and batch function entry traces of a single thread, as
+  // decoded from a single trace file segment, in the order in which they were
+  // traced. Events of any other type end the current run.
+  // @param process_id the process in which the functions were entered.
+  // @param thread_id the thread on which the functions were entered.
+  // @param events the function entry events.
+  // @param num_events the number of events in @p events. This is never zero.
+  virtual void OnFunctionEntryBatch(DWORD process_id,
+                                    DWORD thread_id,
+                                    const FunctionEntryEvent* events,
+                                    size_t num_events) = 0;
+
   // Issued for DLL_PROCESS_ATTACH on an instrumented module.
   virtual void OnProcessAttach(base::Time time,
                                DWORD process_id,
@@ -210,6 +318,32 @@ class ParseEventHandler {
   virtual void OnSampleData(base::Time Time,
                             DWORD process_id,
                             const TraceSampleData* data) = 0;
+
+  // Issued for profiler calibration records.
+  virtual void OnProfilerCalibration(
+      base::Time time,
+      DWORD process_id,
+      const TraceProfilerCalibration* data) = 0;
+
+  // Issued for sampled stack records.
+  virtual void OnSampleStacks(base::Time time,
+                              DWORD process_id,
+                              const TraceSampleStacks* data) = 0;
+
+  // Issued for clock sample records.
+  virtual void OnClockSample(base::Time time,
+                             DWORD process_id,
+                             const TraceClockSample* data) = 0;
+
+  // Issued for data page touch records.
+  virtual void OnDataPageTouches(base::Time time,
+                                 DWORD process_id,
+                                 const TraceDataPageTouches* data) = 0;
+
+  // Issued for records of buffers dropped by the call trace service.
+  virtual void OnBuffersDropped(base::Time time,
+                                DWORD process_id,
+                                const TraceBuffersDropped* data) = 0;
 };
 
 // A default implementation of the ParseEventHandler interface. Provides
@@ -235,6 +369,11 @@ class ParseEventHandlerImpl : public ParseEventHandler {
                                     DWORD process_id,
                                     DWORD thread_id,
                                     const TraceBatchEnterData* data) OVERRIDE;
+  virtual bool WantsFunctionEntryBatches() OVERRIDE;
+  virtual void OnFunctionEntryBatch(DWORD process_id,
+                                    DWORD thread_id,
+                                    const FunctionEntryEvent* events,
+                                    size_t num_events) OVERRIDE;
   virtual void OnProcessAttach(base::Time time,
                                DWORD process_id,
                                DWORD thread_id,
@@ -271,6 +410,22 @@ class ParseEventHandlerImpl : public ParseEventHandler {
   virtual void OnSampleData(base::Time Time,
                             DWORD process_id,
                             const TraceSampleData* data) OVERRIDE;
+  virtual void OnProfilerCalibration(
+      base::Time time,
+      DWORD process_id,
+      const TraceProfilerCalibration* data) OVERRIDE;
+  virtual void OnSampleStacks(base::Time time,
+                              DWORD process_id,
+                              const TraceSampleStacks* data) OVERRIDE;
+  virtual void OnClockSample(base::Time time,
+                             DWORD process_id,
+                             const TraceClockSample* data) OVERRIDE;
+  virtual void OnDataPageTouches(base::Time time,
+                                 DWORD process_id,
+                                 const TraceDataPageTouches* data) OVERRIDE;
+  virtual void OnBuffersDropped(base::Time time,
+                                DWORD process_id,
+                                const TraceBuffersDropped* data) OVERRIDE;
   // @}
 };
 
@@ -24,6 +24,9 @@ namespace testing {
 
 class MockParseEventHandler : public trace::parser::ParseEventHandler {
  public:
+  // Unbatched function entries are far easier to set expectations against.
+  virtual bool WantsFunctionEntryBatches() OVERRIDE { return false; }
+
   MOCK_METHOD3(OnProcessStarted, void(base::Time time,
                                       DWORD process_id,
                                       const TraceSystemInfo* data));
@@ -40,6 +43,11 @@ class MockParseEventHandler : public trace::parser::ParseEventHandler {
                                           DWORD process_id,
                                           DWORD thread_id,
                                           const TraceBatchEnterData* data));
+  MOCK_METHOD4(OnFunctionEntryBatch,
+               void(DWORD process_id,
+                    DWORD thread_id,
+                    const trace::parser::FunctionEntryEvent* events,
+                    size_t num_events));
   MOCK_METHOD4(OnProcessAttach, void(base::Time time,
                                      DWORD process_id,
                                      DWORD thread_id,
@@ -78,6 +86,26 @@ class MockParseEventHandler : public trace::parser::ParseEventHandler {
                void(base::Time time,
                     DWORD process_id,
                     const TraceSampleData* data));
+  MOCK_METHOD3(OnProfilerCalibration,
+               void(base::Time time,
+                    DWORD process_id,
+                    const TraceProfilerCalibration* data));
+  MOCK_METHOD3(OnSampleStacks,
+               void(base::Time time,
+                    DWORD process_id,
+                    const TraceSampleStacks* data));
+  MOCK_METHOD3(OnClockSample,
+               void(base::Time time,
+                    DWORD process_id,
+                    const TraceClockSample* data));
+  MOCK_METHOD3(OnDataPageTouches,
+               void(base::Time time,
+                    DWORD process_id,
+                    const TraceDataPageTouches* data));
+  MOCK_METHOD3(OnBuffersDropped,
+               void(base::Time time,
+                    DWORD process_id,
+                    const TraceBuffersDropped* data));
 };
 
 typedef testing::StrictMock<MockParseEventHandler> StrictMockParseEventHandler;
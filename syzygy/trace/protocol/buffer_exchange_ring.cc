@@ -0,0 +1,68 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/protocol/buffer_exchange_ring.h"
+
+namespace {
+
+// Returns the number of entries between @p tail and @p head, clamped to one
+// more than the capacity. A size beyond the capacity can only happen if the
+// other side has scribbled over the queue; the producer then sees the queue
+// as full and the consumer sees it as empty.
+size_t QueueSize(base::subtle::Atomic32 head, base::subtle::Atomic32 tail) {
+  uint32 size = static_cast<uint32>(head) - static_cast<uint32>(tail);
+  if (size > BufferExchangeQueue::kCapacity)
+    return BufferExchangeQueue::kCapacity + 1;
+  return size;
+}
+
+}  // namespace
+
+bool BufferExchangeQueue::Push(const BufferExchangeEntry& entry) {
+  // The producer owns the head, so it can read it without a barrier. Reading
+  // the tail with acquire semantics ensures the consumer is done with the slot
+  // we're about to overwrite.
+  base::subtle::Atomic32 current_head = head;
+  base::subtle::Atomic32 current_tail = base::subtle::Acquire_Load(&tail);
+  if (QueueSize(current_head, current_tail) >= kCapacity)
+    return false;
+
+  entries[static_cast<uint32>(current_head) % kCapacity] = entry;
+
+  // Publish the entry.
+  base::subtle::Release_Store(&head, current_head + 1);
+  return true;
+}
+
+bool BufferExchangeQueue::Pop(BufferExchangeEntry* entry) {
+  // The mirror image of Push: the consumer owns the tail, and reading the head
+  // with acquire semantics ensures the entry is fully written.
+  base::subtle::Atomic32 current_tail = tail;
+  base::subtle::Atomic32 current_head = base::subtle::Acquire_Load(&head);
+  size_t size = QueueSize(current_head, current_tail);
+  if (size == 0 || size > kCapacity)
+    return false;
+
+  *entry = entries[static_cast<uint32>(current_tail) % kCapacity];
+
+  // Release the slot back to the producer.
+  base::subtle::Release_Store(&tail, current_tail + 1);
+  return true;
+}
+
+size_t BufferExchangeQueue::size() const {
+  size_t size = QueueSize(base::subtle::Acquire_Load(&head),
+                          base::subtle::Acquire_Load(&tail));
+  return size > kCapacity ? 0 : size;
+}
@@ -0,0 +1,79 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the layout of the buffer exchange ring, a block of shared memory
+// through which a call trace client and the call trace service swap buffers
+// without making an RPC call for each of them. The ring holds two
+// single-producer/single-consumer queues of buffer descriptors: the client
+// commits full buffers to one, and picks up fresh buffers that the service has
+// set aside for it from the other. The client signals an event after
+// committing, which prompts the service to drain the committed queue and top
+// up the available one.
+//
+// Either side must be prepared for the other to misbehave, as the memory is
+// writable by both processes. The queues never report more entries than they
+// can hold, and the service validates every descriptor it is handed.
+
+#ifndef SYZYGY_TRACE_PROTOCOL_BUFFER_EXCHANGE_RING_H_
+#define SYZYGY_TRACE_PROTOCOL_BUFFER_EXCHANGE_RING_H_
+
+#include "base/atomicops.h"
+#include "base/basictypes.h"
+
+// Describes a buffer exchanged through the ring. This mirrors the
+// CallTraceBuffer structure of the RPC interface.
+struct BufferExchangeEntry {
+  uint32 shared_memory_handle;
+  uint32 mapping_size;
+  uint32 buffer_offset;
+  uint32 buffer_size;
+};
+
+// A single-producer/single-consumer queue of buffer descriptors. The head and
+// tail are free running counters of the entries pushed and popped,
+// respectively; they are only ever written by the producer and the consumer,
+// respectively.
+struct BufferExchangeQueue {
+  enum { kCapacity = 32 };
+
+  // Pushes an entry onto the queue. This may only be called by the producer.
+  // @param entry the entry to push.
+  // @returns true on success, false if the queue is full.
+  bool Push(const BufferExchangeEntry& entry);
+
+  // Pops an entry from the queue. This may only be called by the consumer.
+  // @param entry receives the popped entry.
+  // @returns true on success, false if the queue is empty.
+  bool Pop(BufferExchangeEntry* entry);
+
+  // @returns the number of entries in the queue. This is exact when called by
+  //     the producer or the consumer with the other one idle, and a snapshot
+  //     otherwise.
+  size_t size() const;
+
+  volatile base::subtle::Atomic32 head;
+  volatile base::subtle::Atomic32 tail;
+  BufferExchangeEntry entries[kCapacity];
+};
+
+// The contents of the shared memory of a buffer exchange ring.
+struct BufferExchangeRing {
+  // Buffers committed by the client, to be written by the service.
+  BufferExchangeQueue committed;
+
+  // Buffers handed out by the service, to be picked up by the client.
+  BufferExchangeQueue available;
+};
+
+#endif  // SYZYGY_TRACE_PROTOCOL_BUFFER_EXCHANGE_RING_H_
@@ -0,0 +1,81 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/protocol/buffer_exchange_ring.h"
+
+#include "gtest/gtest.h"
+
+namespace trace {
+
+namespace {
+
+BufferExchangeEntry MakeEntry(uint32 offset) {
+  BufferExchangeEntry entry = { 0x10, 0x1000, offset, 0x100 };
+  return entry;
+}
+
+}  // namespace
+
+TEST(BufferExchangeQueueTest, PushAndPop) {
+  BufferExchangeQueue queue = {};
+  BufferExchangeEntry entry = {};
+  EXPECT_EQ(0u, queue.size());
+  EXPECT_FALSE(queue.Pop(&entry));
+
+  // Fill the queue, and go around it a few times.
+  for (uint32 i = 0; i < BufferExchangeQueue::kCapacity; ++i)
+    EXPECT_TRUE(queue.Push(MakeEntry(i)));
+  EXPECT_EQ(static_cast<size_t>(BufferExchangeQueue::kCapacity), queue.size());
+  EXPECT_FALSE(queue.Push(MakeEntry(0)));
+
+  for (uint32 i = 0; i < 3 * BufferExchangeQueue::kCapacity; ++i) {
+    ASSERT_TRUE(queue.Pop(&entry));
+    EXPECT_EQ(i, entry.buffer_offset);
+    EXPECT_EQ(0x10u, entry.shared_memory_handle);
+    ASSERT_TRUE(queue.Push(MakeEntry(i + BufferExchangeQueue::kCapacity)));
+  }
+
+  while (queue.Pop(&entry)) {
+  }
+  EXPECT_EQ(0u, queue.size());
+}
+
+TEST(BufferExchangeQueueTest, CountersWrapAround) {
+  BufferExchangeQueue queue = {};
+  queue.head = static_cast<base::subtle::Atomic32>(0xFFFFFFFE);
+  queue.tail = queue.head;
+
+  BufferExchangeEntry entry = {};
+  for (uint32 i = 0; i < 4; ++i)
+    EXPECT_TRUE(queue.Push(MakeEntry(i)));
+  EXPECT_EQ(4u, queue.size());
+  for (uint32 i = 0; i < 4; ++i) {
+    ASSERT_TRUE(queue.Pop(&entry));
+    EXPECT_EQ(i, entry.buffer_offset);
+  }
+  EXPECT_FALSE(queue.Pop(&entry));
+}
+
+TEST(BufferExchangeQueueTest, CorruptQueueIsNeitherPushedNorPopped) {
+  BufferExchangeQueue queue = {};
+  queue.head = 1000;
+  queue.tail = 3;
+
+  BufferExchangeEntry entry = {};
+  EXPECT_EQ(0u, queue.size());
+  EXPECT_FALSE(queue.Pop(&entry));
+  EXPECT_FALSE(queue.Push(MakeEntry(0)));
+}
+
+}  // namespace trace
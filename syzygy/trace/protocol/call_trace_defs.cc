@@ -53,6 +53,17 @@ const char kSyzygyRpcInstanceIdEnvVar[] = "SYZYGY_RPC_INSTANCE_ID";
 // Environment variable used to indicate that an RPC session is mandatory.
 const char kSyzygyRpcSessionMandatoryEnvVar[] =
     "SYZYGY_RPC_SESSION_MANDATORY";
+// Environment variable used to enable data page monitoring in the call trace
+// client.
+const char kSyzygyCallTraceDataPagesEnvVar[] = "SYZYGY_CALL_TRACE_DATA_PAGES";
+// Environment variable used to enable compact batch records in the call trace
+// client.
+const char kSyzygyCallTraceCompactBatchesEnvVar[] =
+    "SYZYGY_CALL_TRACE_COMPACT_BATCHES";
+// Environment variable used to create the call trace client session
+// asynchronously.
+const char kSyzygyCallTraceAsyncSessionEnvVar[] =
+    "SYZYGY_CALL_TRACE_ASYNC_SESSION";
 
 namespace {
 
@@ -80,6 +91,9 @@ void MakeInstanceString(const base::StringPiece16& prefix,
 const TraceFileHeader::Signature TraceFileHeader::kSignatureValue = {
     'S', 'Z', 'G', 'Y' };
 
+const TraceFileIndexFooter::Signature TraceFileIndexFooter::kSignatureValue = {
+    'S', 'Z', 'I', 'X' };
+
 void GetSyzygyCallTraceRpcProtocol(std::wstring* protocol) {
   DCHECK(protocol != NULL);
   protocol->assign(kCallTraceRpcProtocol);
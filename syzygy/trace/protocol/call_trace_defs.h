@@ -63,6 +63,18 @@ void GetSyzygyCallTraceRpcEventName(const base::StringPiece16& id,
 // Environment variable used to indicate that an RPC session is mandatory.
 extern const char kSyzygyRpcSessionMandatoryEnvVar[];
 
+// Environment variable used to make the call trace client record the order in
+// which the data pages of the instrumented modules are first touched.
+extern const char kSyzygyCallTraceDataPagesEnvVar[];
+
+// Environment variable used to make the call trace client write its function
+// entries as compact batch records.
+extern const char kSyzygyCallTraceCompactBatchesEnvVar[];
+
+// Environment variable used to make the call trace client create its session
+// asynchronously, buffering the function entries in the meantime.
+extern const char kSyzygyCallTraceAsyncSessionEnvVar[];
+
 // This must be bumped anytime the file format is changed.
 enum {
   TRACE_VERSION_HI = 1,
@@ -72,6 +84,12 @@ enum {
 enum TraceEventType {
   // Header prefix for a "page" of call trace events.
   TRACE_PAGE_HEADER,
+  // Header prefix for a "page" of call trace events that has been compressed
+  // by the call trace service.
+  TRACE_COMPRESSED_PAGE_HEADER,
+  // Header prefix for the index of the segments of a trace file, written by the
+  // call trace service after the last segment.
+  TRACE_FILE_INDEX,
   // The actual events are below.
   TRACE_PROCESS_STARTED = 10,
   TRACE_PROCESS_ENDED,
@@ -88,6 +106,12 @@ enum TraceEventType {
   TRACE_INDEXED_FREQUENCY,
   TRACE_DYNAMIC_SYMBOL,
   TRACE_SAMPLE_DATA,
+  TRACE_PROFILER_CALIBRATION,
+  TRACE_SAMPLE_STACKS,
+  TRACE_CLOCK_SAMPLE,
+  TRACE_DATA_PAGE_TOUCHES,
+  TRACE_BATCH_ENTER_COMPACT,
+  TRACE_BUFFERS_DROPPED,
 };
 
 // All traces are emitted at this trace level.
@@ -246,6 +270,106 @@ struct TraceFileSegmentHeader {
 };
 COMPILE_ASSERT_IS_POD(TraceFileSegmentHeader);
 
+// Written by the call trace service in place of the TraceFileSegmentHeader of
+// a segment whose content it has compressed. The record prefix type is what
+// flags the segment as compressed. The compressed content follows, and
+// decompresses to the records of the original segment.
+struct TraceFileCompressedSegmentHeader {
+  // Type identifiers used for these headers.
+  enum { kTypeId = TRACE_COMPRESSED_PAGE_HEADER };
+
+  // The supported compression schemes.
+  enum Compression {
+    kZlibCompression = 1,
+  };
+
+  // The identity of the thread that is reporting in this segment
+  // of the trace file.
+  uint32 thread_id;
+
+  // The number of compressed data bytes in this segment of the trace file.
+  // This value does not include the size of the record prefix nor the size
+  // of the segment header.
+  uint32 segment_length;
+
+  // The number of data bytes once decompressed.
+  uint32 uncompressed_length;
+
+  // The compression scheme, one of the Compression values.
+  uint32 compression;
+};
+COMPILE_ASSERT_IS_POD(TraceFileCompressedSegmentHeader);
+
+// Describes a single segment of a trace file in its index.
+struct TraceFileIndexEntry {
+  // The record types that are counted in each entry. Only event types are
+  // counted, starting with TRACE_PROCESS_STARTED.
+  enum {
+    kFirstCountedType = TRACE_PROCESS_STARTED,
+    kNumCountedTypes = TRACE_BUFFERS_DROPPED - TRACE_PROCESS_STARTED + 1,
+  };
+
+  // The offset in the trace file of the segment's record prefix.
+  uint64 segment_offset;
+
+  // The earliest and latest timestamps of the records in the segment. For a
+  // segment without records these are the timestamp of the segment itself.
+  uint64 first_timestamp;
+  uint64 last_timestamp;
+
+  // The identity of the thread that reported the segment.
+  uint32 thread_id;
+
+  // The number of records of each counted type in the segment, indexed by
+  // type - kFirstCountedType.
+  uint32 record_counts[kNumCountedTypes];
+};
+COMPILE_ASSERT_IS_POD(TraceFileIndexEntry);
+
+// Written by the call trace service after the last segment of a trace file,
+// mapping the segments of the file to the threads and times they cover. This
+// lets readers seek straight to the segments they're interested in, rather
+// than scanning the whole file. The index is optional; a trace file written
+// without one simply ends after its last segment.
+//
+// The index is a record that is prefixed like a segment, and holds this header
+// followed by num_entries entries in file order. It is padded to the block
+// size, and the padding ends with a TraceFileIndexFooter, so that the index
+// can be found from the end of the file.
+struct TraceFileIndexHeader {
+  // Type identifiers used for these headers.
+  enum { kTypeId = TRACE_FILE_INDEX };
+
+  // The number of entries in the index.
+  uint32 num_entries;
+
+  // The size of each entry. Entries may grow in later versions, with new
+  // fields being appended.
+  uint32 entry_size;
+};
+COMPILE_ASSERT_IS_POD(TraceFileIndexHeader);
+
+// Occupies the last bytes of a trace file that ends with an index.
+struct TraceFileIndexFooter {
+  // The "magic-number" identifying the footer. In a valid footer this will be
+  // "SZIX".
+  typedef char Signature[4];
+
+  // A canonical value for the signature.
+  static const Signature kSignatureValue;
+
+  // The offset in the trace file of the index's record prefix.
+  uint64 index_offset;
+
+  // The size of the index record, including its record prefix and header,
+  // but not its padding.
+  uint32 index_size;
+
+  // The signature is at the very end of the file.
+  Signature signature;
+};
+COMPILE_ASSERT_IS_POD_OF_SIZE(TraceFileIndexFooter, 16);
+
 // The structure traced on function entry or exit.
 template<int TypeId>
 struct TraceEnterExitEventDataTempl {
@@ -306,6 +430,27 @@ struct TraceBatchEnterData {
 };
 COMPILE_ASSERT_IS_POD(TraceBatchEnterData);
 
+// A compact variant of TraceBatchEnterData, written by the call trace client
+// when asked to. The function entries are encoded as variable length
+// deltas from the previous function, and runs of calls to the same function
+// are coalesced. The return addresses are not recorded.
+struct TraceBatchEnterCompactData {
+  enum { kTypeId = TRACE_BATCH_ENTER_COMPACT };
+
+  // The thread ID from which these traces originate.
+  DWORD thread_id;
+
+  // The number of encoded entries. A repeat entry counts as one entry,
+  // however many calls it stands for.
+  uint32 num_entries;
+
+  // The encoded entries follow this structure, up to the end of the record.
+  // See syzygy/trace/protocol/compact_batch.h for their format. There may be
+  // bytes beyond the last entry if the reporting thread was interrupted
+  // mid-write.
+};
+COMPILE_ASSERT_IS_POD(TraceBatchEnterCompactData);
+
 enum InvocationInfoFlags {
   // If this bit is set in InvocationInfo flags, the caller is a dynamic
   // symbol id, and caller_offset is the offset of the return site, relative to
@@ -429,4 +574,128 @@ struct TraceSampleData {
 };
 COMPILE_ASSERT_IS_POD(TraceSampleData);
 
+// Written by the profiler once per process, ahead of any invocation data, to
+// describe the timing error introduced by the instrumentation.
+struct TraceProfilerCalibration {
+  enum { kTypeId = TRACE_PROFILER_CALIBRATION };
+
+  // The cycles each invocation spends in the instrumentation that the
+  // profiler can't account for at runtime, and that are therefore included
+  // in the cycle counts of the invocation records.
+  uint64 invocation_overhead_cycles;
+
+  // The minimum number of cycles between two consecutive TSC reads.
+  uint64 tsc_read_cycles;
+
+  // The number of processors whose TSC offset was measured.
+  uint32 num_processors;
+
+  // There are actually |num_processors| offsets that follow, in processor
+  // order. Each is the estimated value of the processor's TSC minus that of
+  // the first processor at the same instant.
+  int64 tsc_offsets[1];
+};
+COMPILE_ASSERT_IS_POD(TraceProfilerCalibration);
+
+// Describes a single call stack in a TraceSampleStacks record.
+struct TraceSampleStack {
+  // Identifies the stack among all the stacks sampled in the process.
+  uint32 stack_id;
+
+  // The number of times the stack was sampled over the period of the record.
+  uint32 count;
+
+  // The number of frames of the stack in the frame table of the record. The
+  // frames of a stack are only written in the first record it appears in,
+  // this is zero in subsequent records.
+  uint32 num_frames;
+};
+COMPILE_ASSERT_IS_POD(TraceSampleStack);
+
+// Written by the sampler in stack sampling mode. Holds the call stacks of the
+// threads of a process that were sampled over a period of time.
+struct TraceSampleStacks {
+  enum { kTypeId = TRACE_SAMPLE_STACKS };
+
+  // The time when the period started and ended.
+  uint64 sampling_start_time;
+  uint64 sampling_end_time;
+
+  // The interval between two samples of a thread, expressed in clock cycles.
+  uint64 sampling_interval;
+
+  // The number of stacks in the record, and the total number of frames that
+  // follow them.
+  uint32 num_stacks;
+  uint32 num_frames;
+
+  // There are actually |num_stacks| stacks that follow, followed in turn by
+  // |num_frames| frames. The frames of each stack are consecutive, in stack
+  // order, and innermost first. The innermost frame is the address of the
+  // sampled instruction, the others are return addresses.
+  TraceSampleStack stacks[1];
+};
+COMPILE_ASSERT_IS_POD(TraceSampleStacks);
+
+// Written by the call trace service to all of its sessions, periodically and
+// when they are created. The samples correlate the TSC with the performance
+// counter, which is consistent across processes, and allow the parser to
+// place the events of all processes on a common high resolution timeline.
+struct TraceClockSample {
+  enum { kTypeId = TRACE_CLOCK_SAMPLE };
+
+  // The first sample taken by the service. This is the same for all of its
+  // sessions, and anchors the timeline.
+  trace::common::ClockSample reference;
+
+  // The sample itself.
+  trace::common::ClockSample sample;
+
+  // The frequency of the performance counter, in counts per second.
+  uint64 qpc_frequency;
+};
+COMPILE_ASSERT_IS_POD(TraceClockSample);
+
+// Written by the call trace client when monitoring data page touches. Lists
+// the pages of the data sections of a module in the order they were first
+// touched by the process.
+struct TraceDataPageTouches {
+  enum { kTypeId = TRACE_DATA_PAGE_TOUCHES };
+
+  // This is used to tie the data to a particular module, which has already
+  // been reported via a TraceModuleData struct.
+  ModuleAddr module_base_addr;
+  size_t module_size;
+  uint32 module_checksum;
+  uint32 module_time_date_stamp;
+
+  // The size of the pages, in bytes.
+  uint32 page_size;
+
+  // The number of pages in the record.
+  uint32 num_pages;
+
+  // There are actually |num_pages| page RVAs that follow, in order of first
+  // touch. Each is the RVA of the start of the page in the module.
+  uint32 page_rvas[1];
+};
+COMPILE_ASSERT_IS_POD(TraceDataPageTouches);
+
+// Written by the call trace service when it has discarded buffers returned by
+// the client, rather than writing them, because its writers had fallen behind
+// (see Service::kDropBuffersOnOverload). This accounts for all the buffers
+// dropped since the previous such record, and is written once the backlog
+// clears or when the session closes.
+struct TraceBuffersDropped {
+  enum { kTypeId = TRACE_BUFFERS_DROPPED };
+
+  // The number of buffers that were dropped.
+  uint32 num_buffers;
+
+  // The total size of the buffers that were dropped, in bytes. This is an
+  // upper bound on the amount of trace data that was lost.
+  uint64 num_bytes;
+};
+COMPILE_ASSERT_IS_POD(TraceBuffersDropped);
+
 #endif  // SYZYGY_TRACE_PROTOCOL_CALL_TRACE_DEFS_H_
@@ -0,0 +1,121 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/protocol/compact_batch.h"
+
+#include "base/logging.h"
+
+namespace {
+
+// The first byte of a repeat entry.
+const uint8 kRepeatTag = 0x01;
+
+uint32 FunctionToUint32(FuncAddr function) {
+  return static_cast<uint32>(reinterpret_cast<uintptr_t>(function));
+}
+
+}  // namespace
+
+size_t EncodeCompactBatchCall(FuncAddr previous,
+                              FuncAddr function,
+                              uint8* buffer) {
+  int32 delta = static_cast<int32>(
+      FunctionToUint32(function) - FunctionToUint32(previous));
+  uint32 zigzag = (static_cast<uint32>(delta) << 1) ^
+      static_cast<uint32>(delta >> 31);
+
+  // The low bit of the value is clear for a call entry, which takes up to 33
+  // bits.
+  uint64 value = static_cast<uint64>(zigzag) << 1;
+  size_t size = 0;
+  while (value >= 0x80) {
+    buffer[size++] = static_cast<uint8>(value) | 0x80;
+    value >>= 7;
+  }
+  buffer[size++] = static_cast<uint8>(value);
+
+  DCHECK_LE(size, static_cast<size_t>(kMaxCompactBatchCallSize));
+  return size;
+}
+
+void EncodeCompactBatchRepeat(uint8* buffer) {
+  buffer[0] = kRepeatTag;
+  buffer[1] = 1;
+  buffer[2] = 0;
+}
+
+bool IncrementCompactBatchRepeat(uint8* entry) {
+  DCHECK_EQ(kRepeatTag, entry[0]);
+
+  uint32 count = entry[1] | (entry[2] << 8);
+  if (count >= kMaxCompactBatchRepeatCount)
+    return false;
+
+  // The count is written a byte at a time, low byte first, so that a thread
+  // interrupted in between leaves a count that is short rather than long.
+  ++count;
+  entry[1] = static_cast<uint8>(count);
+  entry[2] = static_cast<uint8>(count >> 8);
+  return true;
+}
+
+bool DecodeCompactBatch(const uint8* data,
+                        size_t length,
+                        size_t num_entries,
+                        std::vector<FuncAddr>* functions) {
+  DCHECK(data != NULL || length == 0);
+  DCHECK(functions != NULL);
+
+  const uint8* end = data + length;
+  uint32 previous = 0;
+  bool have_call = false;
+  for (size_t i = 0; i < num_entries; ++i) {
+    // Read the varint.
+    uint64 value = 0;
+    size_t shift = 0;
+    while (true) {
+      if (data == end || shift >= 7 * kMaxCompactBatchCallSize)
+        return false;
+      uint8 byte = *data++;
+      value |= static_cast<uint64>(byte & 0x7F) << shift;
+      shift += 7;
+      if ((byte & 0x80) == 0)
+        break;
+    }
+
+    if ((value & 1) == 0) {
+      // A call entry.
+      uint32 zigzag = static_cast<uint32>(value >> 1);
+      int32 delta = static_cast<int32>(zigzag >> 1) ^
+          -static_cast<int32>(zigzag & 1);
+      previous += static_cast<uint32>(delta);
+      have_call = true;
+      functions->push_back(
+          reinterpret_cast<FuncAddr>(static_cast<uintptr_t>(previous)));
+      continue;
+    }
+
+    // A repeat entry, which must follow a call entry.
+    if (value != kRepeatTag || !have_call ||
+        static_cast<size_t>(end - data) < kCompactBatchRepeatSize - 1) {
+      return false;
+    }
+    uint32 count = data[0] | (data[1] << 8);
+    data += kCompactBatchRepeatSize - 1;
+    FuncAddr function = functions->back();
+    functions->insert(functions->end(), count, function);
+  }
+
+  return true;
+}
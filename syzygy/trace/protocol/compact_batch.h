@@ -0,0 +1,84 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the encoding of the function entries of a compact batch record,
+// TraceBatchEnterCompactData. The entries are a sequence of:
+//
+//   - call entries, which record a single function entry. They are encoded as
+//     an unsigned LEB128 varint of the zigzag encoded, signed 32-bit distance
+//     from the function of the previous call entry to the function entered,
+//     shifted left by one. The first call entry of a record is relative to
+//     NULL. Calls to functions that are close to one another take one or two
+//     bytes, and no call entry takes more than kMaxCompactBatchCallSize bytes.
+//   - repeat entries, which stand for a number of further calls to the
+//     function of the previous call entry. They are encoded as the byte 0x01
+//     followed by the number of calls as a little-endian uint16, and take
+//     kCompactBatchRepeatSize bytes. The writer bumps the count of the last
+//     entry of the record in place.
+//
+// As all the entries of a record come from the same thread, coalescing runs
+// of calls to a same function also coalesces runs of (function, thread).
+
+#ifndef SYZYGY_TRACE_PROTOCOL_COMPACT_BATCH_H_
+#define SYZYGY_TRACE_PROTOCOL_COMPACT_BATCH_H_
+
+#include <vector>
+
+#include "base/basictypes.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
+
+enum {
+  // The largest size of an encoded call entry.
+  kMaxCompactBatchCallSize = 5,
+  // The size of an encoded repeat entry.
+  kCompactBatchRepeatSize = 3,
+  // The largest number of calls that a repeat entry can stand for.
+  kMaxCompactBatchRepeatCount = 0xFFFF,
+};
+
+// Encodes a call entry.
+// @param previous the function of the previous call entry of the record, or
+//     NULL if this is the first one.
+// @param function the function that was entered.
+// @param buffer receives the entry. It must have room for
+//     kMaxCompactBatchCallSize bytes.
+// @returns the size of the entry, in bytes.
+size_t EncodeCompactBatchCall(FuncAddr previous,
+                              FuncAddr function,
+                              uint8* buffer);
+
+// Encodes a repeat entry standing for one call.
+// @param buffer receives the entry. It must have room for
+//     kCompactBatchRepeatSize bytes.
+void EncodeCompactBatchRepeat(uint8* buffer);
+
+// Adds a call to a repeat entry.
+// @param entry the repeat entry to update.
+// @returns true on success, false if the entry already stands for
+//     kMaxCompactBatchRepeatCount calls.
+bool IncrementCompactBatchRepeat(uint8* entry);
+
+// Decodes the entries of a compact batch record.
+// @param data the encoded entries.
+// @param length the length of @p data, in bytes.
+// @param num_entries the number of entries to decode.
+// @param functions receives the function of each call, in order. Calls that
+//     are coalesced in a repeat entry appear as many times as they occurred.
+// @returns true on success, false if @p data is too short or malformed.
+bool DecodeCompactBatch(const uint8* data,
+                        size_t length,
+                        size_t num_entries,
+                        std::vector<FuncAddr>* functions);
+
+#endif  // SYZYGY_TRACE_PROTOCOL_COMPACT_BATCH_H_
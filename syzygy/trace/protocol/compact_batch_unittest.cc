@@ -0,0 +1,115 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/protocol/compact_batch.h"
+
+#include "gtest/gtest.h"
+
+namespace {
+
+FuncAddr MakeFunction(uint32 address) {
+  return reinterpret_cast<FuncAddr>(static_cast<uintptr_t>(address));
+}
+
+}  // namespace
+
+TEST(CompactBatchTest, CallSizes) {
+  uint8 buffer[kMaxCompactBatchCallSize] = {};
+
+  // Nearby functions take a single byte, in either direction.
+  EXPECT_EQ(1u, EncodeCompactBatchCall(MakeFunction(0x1000),
+                                       MakeFunction(0x1010),
+                                       buffer));
+  EXPECT_EQ(1u, EncodeCompactBatchCall(MakeFunction(0x1010),
+                                       MakeFunction(0x1000),
+                                       buffer));
+  EXPECT_EQ(2u, EncodeCompactBatchCall(MakeFunction(0x1000),
+                                       MakeFunction(0x1800),
+                                       buffer));
+
+  // Distant functions never take more than the maximum.
+  EXPECT_EQ(static_cast<size_t>(kMaxCompactBatchCallSize),
+            EncodeCompactBatchCall(MakeFunction(0),
+                                   MakeFunction(0x80000000),
+                                   buffer));
+  EXPECT_EQ(static_cast<size_t>(kMaxCompactBatchCallSize),
+            EncodeCompactBatchCall(MakeFunction(0x40000000),
+                                   MakeFunction(0xC0000001),
+                                   buffer));
+}
+
+TEST(CompactBatchTest, RoundTrip) {
+  const uint32 kAddresses[] = {
+      0x10001000, 0x10001020, 0x10000FF0, 0x7FFF0000, 0x00000010, 0xFFFFFFF0,
+      0x10001000 };
+
+  std::vector<uint8> data;
+  FuncAddr previous = NULL;
+  for (size_t i = 0; i < arraysize(kAddresses); ++i) {
+    uint8 buffer[kMaxCompactBatchCallSize] = {};
+    FuncAddr function = MakeFunction(kAddresses[i]);
+    size_t size = EncodeCompactBatchCall(previous, function, buffer);
+    data.insert(data.end(), buffer, buffer + size);
+    previous = function;
+  }
+
+  std::vector<FuncAddr> functions;
+  ASSERT_TRUE(DecodeCompactBatch(&data[0], data.size(),
+                                 arraysize(kAddresses), &functions));
+  ASSERT_EQ(arraysize(kAddresses), functions.size());
+  for (size_t i = 0; i < arraysize(kAddresses); ++i)
+    EXPECT_EQ(MakeFunction(kAddresses[i]), functions[i]);
+
+  // Asking for more entries than there are fails.
+  functions.clear();
+  EXPECT_FALSE(DecodeCompactBatch(&data[0], data.size(),
+                                  arraysize(kAddresses) + 1, &functions));
+
+  // Trailing bytes beyond the last entry are ignored.
+  functions.clear();
+  EXPECT_TRUE(DecodeCompactBatch(&data[0], data.size(), 2, &functions));
+  EXPECT_EQ(2u, functions.size());
+}
+
+TEST(CompactBatchTest, Repeats) {
+  std::vector<uint8> data(kMaxCompactBatchCallSize + kCompactBatchRepeatSize);
+  size_t size = EncodeCompactBatchCall(NULL, MakeFunction(0x1000), &data[0]);
+  uint8* repeat = &data[size];
+  EncodeCompactBatchRepeat(repeat);
+  data.resize(size + kCompactBatchRepeatSize);
+
+  std::vector<FuncAddr> functions;
+  ASSERT_TRUE(DecodeCompactBatch(&data[0], data.size(), 2, &functions));
+  EXPECT_EQ(std::vector<FuncAddr>(2, MakeFunction(0x1000)), functions);
+
+  // Bump the count past a carry into the high byte.
+  for (size_t i = 1; i < 300; ++i)
+    ASSERT_TRUE(IncrementCompactBatchRepeat(repeat));
+  functions.clear();
+  ASSERT_TRUE(DecodeCompactBatch(&data[0], data.size(), 2, &functions));
+  EXPECT_EQ(std::vector<FuncAddr>(301, MakeFunction(0x1000)), functions);
+
+  // The count saturates.
+  repeat[1] = 0xFF;
+  repeat[2] = 0xFF;
+  EXPECT_FALSE(IncrementCompactBatchRepeat(repeat));
+
+  // A repeat needs a preceding call.
+  functions.clear();
+  EXPECT_FALSE(DecodeCompactBatch(repeat, kCompactBatchRepeatSize, 1,
+                                  &functions));
+
+  // A truncated repeat is malformed.
+  EXPECT_FALSE(DecodeCompactBatch(&data[0], data.size() - 1, 2, &functions));
+}
@@ -21,8 +21,12 @@
       'target_name': 'protocol_lib',
       'type': 'static_library',
       'sources': [
+        'buffer_exchange_ring.cc',
+        'buffer_exchange_ring.h',
         'call_trace_defs.cc',
         'call_trace_defs.h',
+        'compact_batch.cc',
+        'compact_batch.h',
       ],
       'dependencies': [
         '<(src)/base/base.gyp:base',
@@ -32,7 +36,9 @@
       'target_name': 'protocol_unittests',
       'type': 'executable',
       'sources': [
+        'buffer_exchange_ring_unittest.cc',
         'call_trace_defs_unittest.cc',
+        'compact_batch_unittest.cc',
         'protocol_unittests_main.cc',
       ],
       'dependencies': [
@@ -0,0 +1,184 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/service/parsing_buffer_consumer.h"
+
+#include "base/bind.h"
+#include "base/message_loop.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
+#include "syzygy/trace/service/buffer_pool.h"
+#include "syzygy/trace/service/mapped_buffer.h"
+#include "syzygy/trace/service/session.h"
+#include "syzygy/trace/service/trace_file_writer.h"
+
+namespace trace {
+namespace service {
+
+ParsingBufferConsumer::ParsingBufferConsumer(
+    ParsingBufferConsumerFactory* factory)
+    : factory_(factory), stream_open_(false), buffers_parsed_(0) {
+  DCHECK(factory != NULL);
+}
+
+ParsingBufferConsumer::~ParsingBufferConsumer() {
+}
+
+bool ParsingBufferConsumer::Open(Session* session) {
+  DCHECK(session != NULL);
+
+  // The header is built right away, as it samples the clock information
+  // against which the timestamps of the events are converted.
+  if (!TraceFileWriter::BuildHeader(session->client_info(), block_size(),
+                                    &header_)) {
+    LOG(ERROR) << "Failed to build the trace stream header of process "
+               << session->client_info().process_id << ".";
+    return false;
+  }
+
+  factory_->message_loop()->PostTask(
+      FROM_HERE, base::Bind(&ParsingBufferConsumer::OpenStream, this));
+
+  return true;
+}
+
+bool ParsingBufferConsumer::Close(Session* /* session */) {
+  // Buffers are only recycled once they have been parsed, so by the time the
+  // session closes us there is nothing left to parse.
+  factory_->message_loop()->PostTask(
+      FROM_HERE, base::Bind(&ParsingBufferConsumer::CloseStream, this));
+
+  return true;
+}
+
+bool ParsingBufferConsumer::ConsumeBuffer(Buffer* buffer) {
+  DCHECK(buffer != NULL);
+  DCHECK(buffer->session != NULL);
+
+  factory_->message_loop()->PostTask(
+      FROM_HERE,
+      base::Bind(&ParsingBufferConsumer::ParseBuffer,
+                 this,
+                 scoped_refptr<Session>(buffer->session),
+                 base::Unretained(buffer)));
+
+  return true;
+}
+
+size_t ParsingBufferConsumer::block_size() const {
+  return kBlockSize;
+}
+
+void ParsingBufferConsumer::OpenStream() {
+  DCHECK_EQ(base::MessageLoop::current(), factory_->message_loop());
+  DCHECK(!header_.empty());
+
+  const TraceFileHeader* header =
+      reinterpret_cast<const TraceFileHeader*>(&header_[0]);
+  stream_open_ = factory_->parser()->OpenTraceStream(*header);
+  if (!stream_open_) {
+    LOG(ERROR) << "Failed to open the trace stream of process "
+               << header->process_id << ", its buffers will be dropped.";
+  }
+}
+
+void ParsingBufferConsumer::ParseBuffer(Session* session, Buffer* buffer) {
+  DCHECK(session != NULL);
+  DCHECK(buffer != NULL);
+  DCHECK_EQ(session, buffer->session);
+  DCHECK_EQ(Buffer::kPendingWrite, buffer->state);
+  DCHECK_EQ(base::MessageLoop::current(), factory_->message_loop());
+
+  MappedBuffer mapped_buffer(buffer);
+  if (!mapped_buffer.Map())
+    return;
+
+  // We deliberately ignore invalid records, other than dropping them. This
+  // will log if anything goes wrong.
+  if (stream_open_) {
+    const TraceFileHeader* header =
+        reinterpret_cast<const TraceFileHeader*>(&header_[0]);
+    if (factory_->parser()->ConsumeTraceStreamRecord(*header,
+                                                     mapped_buffer.data(),
+                                                     buffer->buffer_size)) {
+      ++buffers_parsed_;
+    }
+  }
+
+  // As when writing trace files, we clear the RecordPrefix and the
+  // TraceFileSegmentHeader so that the buffer is seen as empty should it be
+  // handed back to us before the client touches it again.
+  ::memset(mapped_buffer.data(), 0,
+           sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader));
+  mapped_buffer.Unmap();
+
+  session->RecycleBuffer(buffer);
+
+  factory_->MaybeEmitResults(false);
+}
+
+void ParsingBufferConsumer::CloseStream() {
+  DCHECK_EQ(base::MessageLoop::current(), factory_->message_loop());
+
+  const TraceFileHeader* header =
+      reinterpret_cast<const TraceFileHeader*>(&header_[0]);
+  VLOG(1) << "Closing the trace stream of process " << header->process_id
+          << " after parsing " << buffers_parsed_ << " buffers.";
+
+  factory_->MaybeEmitResults(false);
+}
+
+ParsingBufferConsumerFactory::ParsingBufferConsumerFactory(
+    base::MessageLoop* message_loop, trace::parser::Parser* parser)
+    : message_loop_(message_loop),
+      parser_(parser),
+      last_emit_time_(base::TimeTicks::Now()) {
+  DCHECK(message_loop != NULL);
+  DCHECK(parser != NULL);
+}
+
+ParsingBufferConsumerFactory::~ParsingBufferConsumerFactory() {
+}
+
+bool ParsingBufferConsumerFactory::CreateConsumer(
+    scoped_refptr<BufferConsumer>* consumer) {
+  DCHECK(consumer != NULL);
+
+  *consumer = new ParsingBufferConsumer(this);
+  return true;
+}
+
+void ParsingBufferConsumerFactory::EmitResults() {
+  message_loop_->PostTask(
+      FROM_HERE,
+      base::Bind(&ParsingBufferConsumerFactory::MaybeEmitResults,
+                 base::Unretained(this),
+                 true));
+}
+
+void ParsingBufferConsumerFactory::MaybeEmitResults(bool force) {
+  DCHECK_EQ(base::MessageLoop::current(), message_loop_);
+
+  if (emit_callback_.is_null())
+    return;
+
+  base::TimeTicks now = base::TimeTicks::Now();
+  if (!force && now - last_emit_time_ < emit_interval_)
+    return;
+
+  last_emit_time_ = now;
+  emit_callback_.Run();
+}
+
+}  // namespace service
+}  // namespace trace
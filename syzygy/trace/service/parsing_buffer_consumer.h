@@ -0,0 +1,190 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file declares the ParsingBufferConsumer class and its factory, a buffer
+// consumer that parses the buffers of each session in memory as they arrive,
+// rather than writing them to a trace file. The events are dispatched to a
+// parse event handler, such as a grinder, whose aggregated results may then be
+// emitted periodically while the service is running.
+//
+// Intended use:
+//
+//   MyGrinder grinder;
+//   trace::parser::Parser parser;
+//   parser.Init(&grinder);
+//   grinder.SetParser(&parser);
+//
+//   ParsingBufferConsumerFactory factory(&parser_thread_message_loop, &parser);
+//   factory.set_emit_callback(base::Bind(&EmitGrinderResults, &grinder),
+//                             base::TimeDelta::FromMinutes(5));
+//   Service service(&factory);
+//   ...
+//   service.Stop();
+//   factory.EmitResults();
+
+#ifndef SYZYGY_TRACE_SERVICE_PARSING_BUFFER_CONSUMER_H_
+#define SYZYGY_TRACE_SERVICE_PARSING_BUFFER_CONSUMER_H_
+
+#include <vector>
+
+#include "base/callback.h"
+#include "base/time.h"
+#include "base/memory/ref_counted.h"
+#include "syzygy/trace/parse/parser.h"
+#include "syzygy/trace/service/buffer_consumer.h"
+
+// Forward declaration.
+namespace base { class MessageLoop; }
+
+namespace trace {
+namespace service {
+
+class ParsingBufferConsumerFactory;
+
+// A buffer consumer that parses the buffers of a session as a trace stream.
+// Parsing happens on the message loop of the factory, which serializes it
+// across all of the sessions. Each buffer is recycled as soon as its events
+// have been dispatched, so nothing is written to disk.
+class ParsingBufferConsumer : public BufferConsumer {
+ public:
+  // The block size of the buffers. As they never reach the disk there is no
+  // need for them to be sector aligned, but this keeps them sized as they
+  // would be when writing trace files.
+  static const size_t kBlockSize = 512;
+
+  // Constructs a consumer that parses its buffers on behalf of @p factory.
+  // The consumer does NOT take ownership of the factory, which must outlive
+  // it.
+  explicit ParsingBufferConsumer(ParsingBufferConsumerFactory* factory);
+
+  // @name BufferConsumer implementation.
+  // @{
+  virtual bool Open(Session* session) OVERRIDE;
+  virtual bool Close(Session* session) OVERRIDE;
+  virtual bool ConsumeBuffer(Buffer* buffer) OVERRIDE;
+  virtual size_t block_size() const OVERRIDE;
+  // @}
+
+ protected:
+  virtual ~ParsingBufferConsumer();
+
+  // Opens the trace stream of the session. This will be called on the
+  // message loop of the factory.
+  void OpenStream();
+
+  // Parses the events of a buffer, then recycles it. This will be called on
+  // the message loop of the factory.
+  void ParseBuffer(Session* session, Buffer* buffer);
+
+  // Notes that the session has ended. This will be called on the message
+  // loop of the factory.
+  void CloseStream();
+
+  // The factory on behalf of which this consumer parses buffers.
+  ParsingBufferConsumerFactory* factory_;
+
+  // The header of the trace stream, as it would be written to a trace file.
+  // This describes the process of the session to the parser.
+  std::vector<uint8> header_;
+
+  // True once the trace stream has been successfully opened. Buffers are
+  // recycled unparsed otherwise. This is only accessed on the message loop.
+  bool stream_open_;
+
+  // The number of buffers parsed. This is only accessed on the message loop.
+  size_t buffers_parsed_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ParsingBufferConsumer);
+};
+
+// This class creates parsing buffer consumers for a call trace service
+// instance. All of the consumers it creates feed the same parser, and hence
+// the same event handler, so the results aggregate the events of every
+// session.
+class ParsingBufferConsumerFactory : public BufferConsumerFactory {
+ public:
+  // Constructs a ParsingBufferConsumerFactory instance.
+  // @param message_loop The message loop on which buffers are parsed. The
+  //     factory does NOT take ownership of it, and it must outlive the
+  //     factory instance.
+  // @param parser The parser to which buffers are fed. It must have been
+  //     initialized with an event handler. The factory does NOT take
+  //     ownership of it, and it must outlive the factory instance. It is
+  //     only used on @p message_loop.
+  ParsingBufferConsumerFactory(base::MessageLoop* message_loop,
+                               trace::parser::Parser* parser);
+
+  ~ParsingBufferConsumerFactory();
+
+  // @name BufferConsumerFactory implementation.
+  // @{
+  virtual bool CreateConsumer(scoped_refptr<BufferConsumer>* consumer) OVERRIDE;
+  // @}
+
+  // Sets the callback that emits the results aggregated by the event handler,
+  // and the minimum interval between invocations. The callback is invoked on
+  // the message loop once a buffer has been parsed or a session has ended,
+  // provided at least @p interval has elapsed since it last ran. It may thus
+  // be invoked many times, and must emit the results as they stand each time.
+  // This must be set before any consumers are created.
+  // @param callback The callback emitting the results.
+  // @param interval The minimum interval between invocations.
+  void set_emit_callback(const base::Closure& callback,
+                         base::TimeDelta interval) {
+    emit_callback_ = callback;
+    emit_interval_ = interval;
+  }
+
+  // Posts an invocation of the emit callback to the message loop, regardless
+  // of the interval. This is meant to be called once the service has stopped,
+  // so that the final results cover every session.
+  void EmitResults();
+
+  // @returns the message loop on which buffers are parsed.
+  base::MessageLoop* message_loop() const { return message_loop_; }
+
+  // @returns the parser to which buffers are fed.
+  trace::parser::Parser* parser() const { return parser_; }
+
+ protected:
+  friend class ParsingBufferConsumer;
+
+  // Invokes the emit callback if it is due, or regardless if @p force is
+  // true. This will be called on the message loop.
+  void MaybeEmitResults(bool force);
+
+  // The message loop on which buffers are parsed.
+  base::MessageLoop* const message_loop_;
+
+  // The parser to which buffers are fed.
+  trace::parser::Parser* const parser_;
+
+  // The callback emitting the results, and the minimum interval between its
+  // invocations.
+  base::Closure emit_callback_;
+  base::TimeDelta emit_interval_;
+
+  // The time at which results were last emitted. This is only accessed on the
+  // message loop.
+  base::TimeTicks last_emit_time_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ParsingBufferConsumerFactory);
+};
+
+}  // namespace service
+}  // namespace trace
+
+#endif  // SYZYGY_TRACE_SERVICE_PARSING_BUFFER_CONSUMER_H_
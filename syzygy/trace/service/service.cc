@@ -21,6 +21,8 @@
 
 #include "syzygy/trace/service/service.h"
 
+#include <vector>
+
 #include "base/bind.h"
 #include "base/callback.h"
 #include "base/string_util.h"
@@ -45,11 +47,27 @@ const size_t Service::kDefaultNumIncrementalBuffers = 16;
 // represents about 26 MB, so 1.3 seconds of disk bandwidth.
 const size_t Service::kDefaultMaxBuffersPendingWrite = 13;
 
+// A client exchanging 32MB buffers at the rate that triggers growth is
+// producing at least a few hundred MB/sec, which is about as much as a disk
+// will absorb. Beyond that, bigger buffers only cost memory.
+const size_t Service::kDefaultMaxBufferSize = 32 * 1024 * 1024;
+const size_t Service::kDefaultBufferMemoryBudget = 1024 * 1024 * 1024;
+
+const uint32 Service::kDefaultClockSampleIntervalMs = 1000;
+
 Service::Service(BufferConsumerFactory* factory)
     : num_active_sessions_(0),
       num_incremental_buffers_(kDefaultNumIncrementalBuffers),
       buffer_size_in_bytes_(kDefaultBufferSize),
       max_buffers_pending_write_(kDefaultMaxBuffersPendingWrite),
+      overload_policy_(kWaitOnOverload),
+      adaptive_buffer_sizing_(false),
+      max_buffer_size_in_bytes_(kDefaultMaxBufferSize),
+      buffer_memory_budget_(kDefaultBufferMemoryBudget),
+      buffer_memory_in_use_(0),
+      clock_sample_interval_ms_(0),
+      qpc_frequency_(0),
+      clock_sample_timer_(NULL),
       owner_thread_(base::PlatformThread::CurrentId()),
       buffer_consumer_factory_(factory),
       a_session_has_closed_(&lock_),
@@ -58,6 +76,7 @@ Service::Service(BufferConsumerFactory* factory)
       rpc_is_non_blocking_(false),
       flags_(TRACE_FLAG_BATCH_ENTER) {
   DCHECK(factory != NULL);
+  ::memset(&clock_reference_, 0, sizeof(clock_reference_));
 }
 
 Service::~Service() {
@@ -87,6 +106,22 @@ void Service::RemoveOneActiveSession() {
   a_session_has_closed_.Signal();
 }
 
+void Service::AddBufferMemory(size_t bytes) {
+  base::AutoLock auto_lock(buffer_memory_lock_);
+  buffer_memory_in_use_ += bytes;
+}
+
+void Service::RemoveBufferMemory(size_t bytes) {
+  base::AutoLock auto_lock(buffer_memory_lock_);
+  DCHECK_LE(bytes, buffer_memory_in_use_);
+  buffer_memory_in_use_ -= bytes;
+}
+
+size_t Service::buffer_memory_in_use() const {
+  base::AutoLock auto_lock(buffer_memory_lock_);
+  return buffer_memory_in_use_;
+}
+
 bool Service::OpenServiceEvent() {
   DCHECK_EQ(owner_thread_, base::PlatformThread::CurrentId());
   DCHECK(!service_event_.IsValid());
@@ -313,7 +348,13 @@ bool Service::Start(bool non_blocking) {
   if (!OpenServiceEvent())
     return false;
 
+  if (!StartClockSampling()) {
+    ReleaseServiceMutex();
+    return false;
+  }
+
   if (!InitializeRpc()) {
+    StopClockSampling();
     ReleaseServiceMutex();
     return false;
   }
@@ -335,6 +376,7 @@ bool Service::Stop() {
 
   StopRpc();
   CleanupRpc();
+  StopClockSampling();
   CloseAllOpenSessions();
   ReleaseServiceMutex();
 
@@ -384,6 +426,86 @@ bool Service::CloseAllOpenSessions() {
   return true;
 }
 
+bool Service::StartClockSampling() {
+  DCHECK_EQ(owner_thread_, base::PlatformThread::CurrentId());
+  DCHECK(clock_sample_timer_ == NULL);
+
+  if (clock_sample_interval_ms_ == 0)
+    return true;
+
+  qpc_frequency_ = trace::common::GetQpcFrequency();
+  if (qpc_frequency_ == 0) {
+    LOG(WARNING) << "No performance counter, clock sampling is disabled.";
+    return true;
+  }
+  trace::common::GetClockSample(&clock_reference_);
+
+  if (!::CreateTimerQueueTimer(&clock_sample_timer_, NULL,
+                               &OnClockSampleTimer, this,
+                               clock_sample_interval_ms_,
+                               clock_sample_interval_ms_,
+                               WT_EXECUTEDEFAULT)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to create clock sampling timer: "
+               << com::LogWe(error) << ".";
+    clock_sample_timer_ = NULL;
+    qpc_frequency_ = 0;
+    return false;
+  }
+
+  return true;
+}
+
+void Service::StopClockSampling() {
+  DCHECK_EQ(owner_thread_, base::PlatformThread::CurrentId());
+
+  // This waits for any running timer callback to complete.
+  if (clock_sample_timer_ != NULL &&
+      !::DeleteTimerQueueTimer(NULL, clock_sample_timer_,
+                               INVALID_HANDLE_VALUE)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to delete clock sampling timer: "
+               << com::LogWe(error) << ".";
+  }
+  clock_sample_timer_ = NULL;
+  qpc_frequency_ = 0;
+}
+
+void Service::WriteClockSample(Session* session) {
+  DCHECK(session != NULL);
+  DCHECK_NE(0u, qpc_frequency_);
+
+  TraceClockSample clock_sample = {};
+  clock_sample.reference = clock_reference_;
+  trace::common::GetClockSample(&clock_sample.sample);
+  clock_sample.qpc_frequency = qpc_frequency_;
+
+  if (!session->WriteClockSample(clock_sample)) {
+    LOG(ERROR) << "Failed to write clock sample for process "
+               << session->client_process_id() << ".";
+  }
+}
+
+void Service::WriteClockSamples() {
+  // Write outside of lock_, as the sessions acquire their own locks.
+  std::vector<scoped_refptr<Session>> sessions;
+  {
+    base::AutoLock auto_lock(lock_);
+    sessions.reserve(sessions_.size());
+    SessionMap::iterator iter = sessions_.begin();
+    for (; iter != sessions_.end(); ++iter)
+      sessions.push_back(iter->second);
+  }
+
+  for (size_t i = 0; i < sessions.size(); ++i)
+    WriteClockSample(sessions[i].get());
+}
+
+VOID CALLBACK Service::OnClockSampleTimer(PVOID context, BOOLEAN timed_out) {
+  DCHECK(context != NULL);
+  static_cast<Service*>(context)->WriteClockSamples();
+}
+
 Session* Service::CreateSession() {
   return new Session(this);
 }
@@ -579,6 +701,31 @@ bool Service::CloseSession(SessionHandle* session_handle) {
   return true;
 }
 
+// RPC entry point.
+bool Service::CreateExchangeRing(SessionHandle session_handle,
+                                 unsigned long* ring_handle,
+                                 unsigned long* event_handle) {
+  if (session_handle == NULL || ring_handle == NULL || event_handle == NULL) {
+    LOG(WARNING) << "Invalid RPC parameters.";
+    return false;
+  }
+
+  scoped_refptr<Session> session;
+  if (!GetExistingSession(session_handle, &session))
+    return false;
+  DCHECK(session.get() != NULL);
+
+  HANDLE client_ring_handle = NULL;
+  HANDLE client_event_handle = NULL;
+  if (!session->CreateExchangeRing(&client_ring_handle, &client_event_handle))
+    return false;
+
+  *ring_handle = reinterpret_cast<unsigned long>(client_ring_handle);
+  *event_handle = reinterpret_cast<unsigned long>(client_event_handle);
+
+  return true;
+}
+
 bool Service::GetNewSession(ProcessId client_process_id,
                             scoped_refptr<Session>* session) {
   DCHECK(session != NULL);
@@ -606,6 +753,11 @@ bool Service::GetNewSession(ProcessId client_process_id,
   // returned buffers to the consumer.
   new_session->set_buffer_consumer(consumer);
 
+  // Start the session off with a clock sample, so that its events are on the
+  // common timeline from the start.
+  if (qpc_frequency_ != 0)
+    WriteClockSample(new_session.get());
+
   bool inserted = false;
   {
     base::AutoLock auto_lock(lock_);
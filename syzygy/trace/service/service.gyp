@@ -34,6 +34,10 @@
         'service_rpc_impl.h',
         'session.cc',
         'session.h',
+        'session_stream_writer.cc',
+        'session_stream_writer.h',
+        'session_stream_writer_factory.cc',
+        'session_stream_writer_factory.h',
         'session_trace_file_writer.cc',
         'session_trace_file_writer.h',
         'session_trace_file_writer_factory.cc',
@@ -44,9 +48,30 @@
       'dependencies': [
         '<(src)/base/base.gyp:base',
         '<(src)/sawbuck/log_lib/log_lib.gyp:log_lib',
+        '<(src)/syzygy/core/core.gyp:core_lib',
         '<(src)/syzygy/trace/common/common.gyp:trace_common_lib',
+        '<(src)/syzygy/trace/protocol/protocol.gyp:protocol_lib',
         '<(src)/syzygy/trace/rpc/rpc.gyp:rpc_common_lib',
       ],
+      'libraries': [
+        'ws2_32.lib',
+      ],
+    },
+    {
+      # The in-memory parsing buffer consumer lives in its own library, so
+      # that the call trace service itself doesn't depend on the parser.
+      'target_name': 'rpc_service_parsing_lib',
+      'type': 'static_library',
+      'sources': [
+        'parsing_buffer_consumer.cc',
+        'parsing_buffer_consumer.h',
+      ],
+      'dependencies': [
+        'rpc_service_lib',
+        '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/trace/parse/parse.gyp:parse_lib',
+        '<(src)/syzygy/trace/protocol/protocol.gyp:protocol_lib',
+      ],
     },
     {
       'target_name': 'rpc_service_unittests',
@@ -26,8 +26,10 @@
 #include "base/files/file_path.h"
 #include "base/memory/ref_counted.h"
 #include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
 #include "base/threading/platform_thread.h"
 #include "base/threading/thread.h"
+#include "syzygy/trace/common/clock.h"
 #include "syzygy/trace/rpc/call_trace_rpc.h"
 
 namespace trace {
@@ -65,6 +67,19 @@ class Service {
     PERFORM_EXCHANGE
   };
 
+  // How sessions respond to their buffers being written more slowly than the
+  // client fills them, i.e. to more than max_buffers_pending_write() buffers
+  // pending write.
+  enum OverloadPolicy {
+    // Buffer requests wait for a buffer to be written, or allocate more
+    // buffers. No data is lost, but the client's latency is unbounded.
+    kWaitOnOverload,
+    // Buffers returned by the client are recycled without being written, and
+    // accounted for by a TRACE_BUFFERS_DROPPED record. Buffer requests never
+    // wait for the writers.
+    kDropBuffersOnOverload,
+  };
+
   // Construct a new call trace Service instance. The service will use the
   // given @p factory to construct buffer consumers for new sessions. The
   // service instance does NOT take ownership of the @p factory, which must
@@ -83,6 +98,18 @@ class Service {
   // allow before beginning to force writes.
   static const size_t kDefaultMaxBuffersPendingWrite;
 
+  // The default upper bound (in bytes) on the size of the buffers that
+  // adaptive buffer sizing may grow a session's buffers to.
+  static const size_t kDefaultMaxBufferSize;
+
+  // The default budget (in bytes) of buffer memory across all sessions,
+  // beyond which adaptive buffer sizing stops growing buffers.
+  static const size_t kDefaultBufferMemoryBudget;
+
+  // The default interval (in milliseconds) between the clock samples written
+  // to all sessions, for services that enable clock sampling.
+  static const uint32 kDefaultClockSampleIntervalMs;
+
   // Set the id for this instance.
   void set_instance_id(const base::StringPiece16& id) {
     DCHECK(!is_running());
@@ -119,6 +146,55 @@ class Service {
     max_buffers_pending_write_ = n;
   }
 
+  // Sets how sessions respond to a backlog of buffers pending write. This
+  // defaults to kWaitOnOverload.
+  void set_overload_policy(OverloadPolicy policy) {
+    overload_policy_ = policy;
+  }
+
+  // Enables or disables adaptive buffer sizing. When enabled, sessions whose
+  // clients exchange buffers frequently allocate progressively larger buffers,
+  // up to max_buffer_size_in_bytes(), while idle sessions fall back towards
+  // buffer_size_in_bytes(). Growth stops while the buffer memory in use by all
+  // sessions exceeds buffer_memory_budget().
+  void set_adaptive_buffer_sizing(bool enabled) {
+    adaptive_buffer_sizing_ = enabled;
+  }
+
+  // Sets the size (in bytes) that adaptive buffer sizing may grow buffers to.
+  void set_max_buffer_size_in_bytes(size_t n) {
+    max_buffer_size_in_bytes_ = n;
+  }
+
+  // Sets the budget (in bytes) of buffer memory that adaptive buffer sizing
+  // may grow into.
+  void set_buffer_memory_budget(size_t n) {
+    buffer_memory_budget_ = n;
+  }
+
+  // Sets the interval (in milliseconds) at which the service writes clock
+  // samples to all sessions. Sessions also get a sample when they are
+  // created. The samples let the parser place the events of all sessions on
+  // a common high resolution timeline. Zero, the default, disables clock
+  // sampling.
+  void set_clock_sample_interval_ms(uint32 interval_ms) {
+    DCHECK(!is_running());
+    clock_sample_interval_ms_ = interval_ms;
+  }
+
+  // @returns the interval (in milliseconds) between clock samples, zero if
+  //     clock sampling is disabled.
+  uint32 clock_sample_interval_ms() const { return clock_sample_interval_ms_; }
+
+  // @returns true if adaptive buffer sizing is enabled.
+  bool adaptive_buffer_sizing() const { return adaptive_buffer_sizing_; }
+
+  // @returns the size (in bytes) adaptive buffer sizing may grow buffers to.
+  size_t max_buffer_size_in_bytes() const { return max_buffer_size_in_bytes_; }
+
+  // @returns the budget (in bytes) of buffer memory across all sessions.
+  size_t buffer_memory_budget() const { return buffer_memory_budget_; }
+
   // @returns the number of new buffers to be created per allocation.
   size_t num_incremental_buffers() const { return num_incremental_buffers_; }
 
@@ -131,6 +207,9 @@ class Service {
     return max_buffers_pending_write_;
   }
 
+  // @returns how sessions respond to a backlog of buffers pending write.
+  OverloadPolicy overload_policy() const { return overload_policy_; }
+
   // Returns true if any of the service's subsystems are running.
   bool is_running() const {
     return rpc_is_running_ || num_active_sessions_ > 0;
@@ -200,6 +279,12 @@ class Service {
   // See call_trace_rpc.idl for further info.
   bool CloseSession(SessionHandle* session_handle);
 
+  // RPC implementation of CallTraceService::CreateExchangeRing().
+  // See call_trace_rpc.idl for further info.
+  bool CreateExchangeRing(SessionHandle session_handle,
+                          unsigned long* ring_handle,
+                          unsigned long* event_handle);
+
   // Decrement the active session count.
   // @see num_active_sessions_
   void RemoveOneActiveSession();
@@ -208,6 +293,17 @@ class Service {
   // @see num_active_sessions_.
   void AddOneActiveSession();
 
+  // Accounts for buffer memory being allocated or released by a session.
+  // These are thread-safe.
+  // @param bytes the size of the buffer pool being allocated or released.
+  // @{
+  void AddBufferMemory(size_t bytes);
+  void RemoveBufferMemory(size_t bytes);
+  // @}
+
+  // @returns the buffer memory (in bytes) currently allocated by all sessions.
+  size_t buffer_memory_in_use() const;
+
  // These are protected for unittesting.
  protected:
 
@@ -249,6 +345,25 @@ class Service {
   // Session factory. This is virtual for testing purposes.
   virtual Session* CreateSession();
 
+  // @name Clock sampling.
+  // @{
+  // Takes the reference clock sample and starts the timer that writes clock
+  // samples to all sessions, if clock sampling is enabled. These must be
+  // called from the thread that created this instance.
+  bool StartClockSampling();
+  void StopClockSampling();
+
+  // Writes a clock sample to @p session.
+  void WriteClockSample(Session* session);
+
+  // Writes a clock sample to all open sessions.
+  void WriteClockSamples();
+
+  // The timer callback. Calls WriteClockSamples on the service passed as
+  // @p context.
+  static VOID CALLBACK OnClockSampleTimer(PVOID context, BOOLEAN timed_out);
+  // @}
+
   // Protects concurrent access to the internals, except for write-queue
   // related internals.
   base::Lock lock_;
@@ -277,6 +392,37 @@ class Service {
   // The maximum number of buffers that a session should have pending write.
   size_t max_buffers_pending_write_;
 
+  // How sessions respond to more than max_buffers_pending_write_ buffers
+  // pending write.
+  OverloadPolicy overload_policy_;
+
+  // Whether adaptive buffer sizing is enabled.
+  bool adaptive_buffer_sizing_;
+
+  // The size that adaptive buffer sizing may grow buffers to.
+  size_t max_buffer_size_in_bytes_;
+
+  // The buffer memory budget for adaptive buffer sizing.
+  size_t buffer_memory_budget_;
+
+  // Protects buffer_memory_in_use_. This is distinct from lock_, as sessions
+  // update it while holding their own locks.
+  mutable base::Lock buffer_memory_lock_;
+
+  // The buffer memory currently allocated by all sessions.
+  size_t buffer_memory_in_use_;  // Under buffer_memory_lock_.
+
+  // The interval between clock samples, zero if clock sampling is disabled.
+  uint32 clock_sample_interval_ms_;
+
+  // The first clock sample, taken when the service starts, and the frequency
+  // of the performance counter. All clock samples refer to these.
+  trace::common::ClockSample clock_reference_;
+  uint64 qpc_frequency_;
+
+  // The timer queue timer that writes the clock samples, if one is running.
+  HANDLE clock_sample_timer_;
+
   // Handle to the thread that owns/created this call trace service instance.
   base::PlatformThreadId owner_thread_;
 
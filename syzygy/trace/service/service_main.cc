@@ -15,6 +15,7 @@
 #include <iostream>
 
 #include "base/at_exit.h"
+#include "base/bind.h"
 #include "base/command_line.h"
 #include "base/environment.h"
 #include "base/file_util.h"
@@ -24,9 +25,11 @@
 #include "base/string_number_conversions.h"
 #include "base/string_piece.h"
 #include "base/string_util.h"
+#include "base/stringprintf.h"
 #include "base/utf_string_conversions.h"
 #include "base/files/file_path.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/memory/scoped_vector.h"
 #include "base/threading/thread.h"
 #include "sawbuck/common/com_utils.h"
 #include "syzygy/trace/common/service_util.h"
@@ -34,6 +37,7 @@
 #include "syzygy/trace/rpc/rpc_helpers.h"
 #include "syzygy/trace/service/service.h"
 #include "syzygy/trace/service/service_rpc_impl.h"
+#include "syzygy/trace/service/session_stream_writer_factory.h"
 #include "syzygy/trace/service/session_trace_file_writer_factory.h"
 
 namespace trace {
@@ -49,6 +53,22 @@ const int kMinBufferSize = 1024 * 1024;
 // Minimum number of buffers to allocate.
 const int kMinBuffers = 16;
 
+// Maximum buffer memory budget to allow (in MB). This keeps the budget
+// representable in a size_t.
+const int kMaxBufferMemoryBudgetMb = 4095;
+
+// Maximum interval between clock samples to allow (in ms).
+const int kMaxClockSampleIntervalMs = 60 * 1000;
+
+// Maximum number of writer threads to run.
+const int kMaxWriterThreads = 64;
+
+// Maximum trace file chunk size to allow (in MB).
+const int kMaxChunkSizeMb = 1024 * 1024;
+
+// Maximum trace file chunk duration to allow (in seconds).
+const int kMaxChunkDurationS = 7 * 24 * 60 * 60;
+
 // A static location to which the current instance id can be saved. We
 // persist it here so that OnConsoleCtrl can have access to the instance
 // id when it is invoked on the signal handler thread.
@@ -83,12 +103,61 @@ const char kUsage[] =
     "Options:\n"
     "  --help             Show this help message.\n"
     "  --trace-dir=PATH   The directory in which to write the trace files.\n"
+    "  --compress         Compress the trace file segments as they are\n"
+    "                     written. This trades CPU time on the writer\n"
+    "                     threads for disk bandwidth.\n"
+    "  --index            Append an index of the segments to each trace\n"
+    "                     file, allowing time ranges and threads to be\n"
+    "                     parsed without reading the whole file.\n"
+    "  --chunk-size=NUM   Rotate each trace file once its segments reach NUM\n"
+    "                     MB, writing it as numbered chunks. Each chunk is a\n"
+    "                     complete trace file, so it can be processed while\n"
+    "                     the process is still being traced.\n"
+    "  --chunk-duration=NUM\n"
+    "                     Rotate each trace file once it is NUM seconds old.\n"
+    "  --chunk-command=COMMAND\n"
+    "                     A command to launch for each trace file, or chunk,\n"
+    "                     as soon as it is complete. The path of the trace\n"
+    "                     file is appended to COMMAND, and the command is not\n"
+    "                     waited for.\n"
+    "  --stream-to=HOST:PORT\n"
+    "                     Stream each session over TCP to an aggregation\n"
+    "                     server rather than writing trace files. The stream\n"
+    "                     is laid out as a trace file, and is compressed if\n"
+    "                     --compress is given. Sessions are streamed from\n"
+    "                     the first writer thread.\n"
     "  --buffer-size=NUM  The size (in bytes) of each buffer to allocate.\n"
     "  --num-incremental-buffers=NUM\n"
     "                     The number of buffers by which to grow the buffer\n"
     "                     pool each time the client exhausts its available\n"
     "                     buffer space.\n"
+    "  --adaptive-buffers Grow the buffers of clients that fill them quickly,\n"
+    "                     and shrink those of idle clients.\n"
+    "  --buffer-memory-budget=NUM\n"
+    "                     The amount (in MB) of buffer memory across all\n"
+    "                     clients beyond which adaptive buffers stop growing.\n"
+    "  --overload-policy=POLICY\n"
+    "                     What to do when the writers fall behind a client.\n"
+    "                     One of 'wait' (the default), which makes the\n"
+    "                     client wait for buffers, or 'drop', which discards\n"
+    "                     the client's buffers unwritten and records how\n"
+    "                     many were lost, keeping the client's latency\n"
+    "                     bounded.\n"
+    "  --clock-sample-interval=NUM\n"
+    "                     The interval (in ms) at which clock samples are\n"
+    "                     written to all trace files, allowing the events of\n"
+    "                     all processes to be ordered precisely. 0 disables\n"
+    "                     clock sampling. By default this is 1000.\n"
     "  --enable-exits     Enable exit tracing (off by default).\n"
+    "  --writer-threads=NUM\n"
+    "                     The number of threads on which to write trace\n"
+    "                     files. Each session is written from a single\n"
+    "                     thread. By default this is 1.\n"
+    "  --writer-scheduling=POLICY\n"
+    "                     How sessions are assigned to writer threads. One of\n"
+    "                     'round-robin' (the default) or 'bytes-weighted',\n"
+    "                     which prefers the threads that have written the\n"
+    "                     least for their active sessions.\n"
     "  --verbose          Increase the logging verbosity to also include\n"
     "                     debug-level information.\n"
     "  --instance-id=ID   A unique identifier to use for the RPC endpoint.\n"
@@ -118,6 +187,21 @@ bool GetInstanceId(const CommandLine* cmd_line, std::wstring* id) {
   return true;
 }
 
+// Launches @p command with the path of a completed trace file appended to it.
+// This is run on the trace file writer threads.
+void LaunchChunkCommand(const CommandLine& command,
+                        const base::FilePath& trace_file_path) {
+  CommandLine command_line(command);
+  command_line.AppendArgPath(trace_file_path);
+
+  VLOG(1) << "Launching '" << command_line.GetCommandLineString() << "'.";
+  base::LaunchOptions options;
+  if (!base::LaunchProcess(command_line, options, NULL)) {
+    LOG(ERROR)
+        << "Failed to launch '" << command_line.GetProgram().value() << "'.";
+  }
+}
+
 // A helper function which sets the Syzygy RPC instance id environment variable
 // then runs a given command line to completion.
 // TODO(etienneb): We should merge common code of logger and call_service.
@@ -157,16 +241,71 @@ bool RunService(const CommandLine* cmd_line,
   DCHECK(cmd_line != NULL);
   DCHECK(app_cmd_line != NULL);
 
-  base::Thread writer_thread("trace-file-writer");
-  if (!writer_thread.StartWithOptions(
-          base::Thread::Options(MessageLoop::TYPE_IO, 0))) {
-    LOG(ERROR) << "Failed to start call trace service writer thread.";
-    return 1;
+  // Get the number of writer threads and how to schedule sessions on them.
+  int num_writer_threads = 1;
+  std::wstring writer_threads_str(
+      cmd_line->GetSwitchValueNative("writer-threads"));
+  if (!writer_threads_str.empty()) {
+    if (!base::StringToInt(writer_threads_str, &num_writer_threads) ||
+        num_writer_threads < 1 || num_writer_threads > kMaxWriterThreads) {
+      LOG(ERROR) << "The number of writer threads must be between 1 and "
+                 << kMaxWriterThreads << ".";
+      return false;
+    }
+  }
+
+  SessionTraceFileWriterFactory::SchedulingPolicy policy =
+      SessionTraceFileWriterFactory::kRoundRobin;
+  std::string scheduling_str(
+      cmd_line->GetSwitchValueASCII("writer-scheduling"));
+  if (scheduling_str == "bytes-weighted") {
+    policy = SessionTraceFileWriterFactory::kBytesWeighted;
+  } else if (!scheduling_str.empty() && scheduling_str != "round-robin") {
+    LOG(ERROR) << "Unknown writer scheduling policy '" << scheduling_str
+               << "'.";
+    return false;
+  }
+
+  ScopedVector<base::Thread> writer_threads;
+  std::vector<MessageLoop*> message_loops;
+  for (int i = 0; i < num_writer_threads; ++i) {
+    writer_threads.push_back(new base::Thread(
+        base::StringPrintf("trace-file-writer-%d", i)));
+    if (!writer_threads.back()->StartWithOptions(
+            base::Thread::Options(MessageLoop::TYPE_IO, 0))) {
+      LOG(ERROR) << "Failed to start call trace service writer thread.";
+      return false;
+    }
+    message_loops.push_back(writer_threads.back()->message_loop());
   }
 
-  MessageLoop* message_loop = writer_thread.message_loop();
-  SessionTraceFileWriterFactory session_trace_file_writer_factory(message_loop);
-  Service call_trace_service(&session_trace_file_writer_factory);
+  SessionTraceFileWriterFactory session_trace_file_writer_factory(
+      message_loops, policy);
+  BufferConsumerFactory* buffer_consumer_factory =
+      &session_trace_file_writer_factory;
+
+  // Stream the sessions to an aggregation server instead, if requested.
+  scoped_ptr<SessionStreamWriterFactory> session_stream_writer_factory;
+  std::string stream_to(cmd_line->GetSwitchValueASCII("stream-to"));
+  if (!stream_to.empty()) {
+    size_t colon = stream_to.rfind(':');
+    if (colon == std::string::npos || colon == 0 ||
+        colon + 1 == stream_to.size()) {
+      LOG(ERROR) << "Invalid aggregation server '" << stream_to
+                 << "', expected HOST:PORT.";
+      return false;
+    }
+    session_stream_writer_factory.reset(new SessionStreamWriterFactory(
+        message_loops[0], stream_to.substr(0, colon),
+        stream_to.substr(colon + 1)));
+    if (!session_stream_writer_factory->Init())
+      return false;
+    if (cmd_line->HasSwitch("compress"))
+      session_stream_writer_factory->set_compress_segments(true);
+    buffer_consumer_factory = session_stream_writer_factory.get();
+  }
+
+  Service call_trace_service(buffer_consumer_factory);
   RpcServiceInstanceManager rpc_instance(&call_trace_service);
 
   // Get/set the instance id.
@@ -185,6 +324,43 @@ bool RunService(const CommandLine* cmd_line,
     trace_directory = base::FilePath(L".");
   if (!session_trace_file_writer_factory.SetTraceFileDirectory(trace_directory))
     return false;
+  if (cmd_line->HasSwitch("compress"))
+    session_trace_file_writer_factory.set_compress_segments(true);
+  if (cmd_line->HasSwitch("index"))
+    session_trace_file_writer_factory.set_write_index(true);
+
+  // Setup the trace file rotation.
+  std::wstring chunk_size_str(cmd_line->GetSwitchValueNative("chunk-size"));
+  if (!chunk_size_str.empty()) {
+    int num = 0;
+    if (!base::StringToInt(chunk_size_str, &num) || num < 1 ||
+        num > kMaxChunkSizeMb) {
+      LOG(ERROR) << "The chunk size must be between 1 and "
+                 << kMaxChunkSizeMb << " MB.";
+      return false;
+    }
+    session_trace_file_writer_factory.set_max_chunk_size(
+        static_cast<uint64>(num) * 1024 * 1024);
+  }
+  std::wstring chunk_duration_str(
+      cmd_line->GetSwitchValueNative("chunk-duration"));
+  if (!chunk_duration_str.empty()) {
+    int num = 0;
+    if (!base::StringToInt(chunk_duration_str, &num) || num < 1 ||
+        num > kMaxChunkDurationS) {
+      LOG(ERROR) << "The chunk duration must be between 1 and "
+                 << kMaxChunkDurationS << " seconds.";
+      return false;
+    }
+    session_trace_file_writer_factory.set_max_chunk_duration(
+        base::TimeDelta::FromSeconds(num));
+  }
+  std::wstring chunk_command_str(
+      cmd_line->GetSwitchValueNative("chunk-command"));
+  if (!chunk_command_str.empty()) {
+    session_trace_file_writer_factory.set_chunk_callback(base::Bind(
+        &LaunchChunkCommand, CommandLine::FromString(chunk_command_str)));
+  }
 
   // Setup the buffer size.
   std::wstring buffer_size_str(cmd_line->GetSwitchValueNative("buffer-size"));
@@ -197,6 +373,48 @@ bool RunService(const CommandLine* cmd_line,
     call_trace_service.set_buffer_size_in_bytes(num);
   }
 
+  // Setup adaptive buffer sizing.
+  if (cmd_line->HasSwitch("adaptive-buffers"))
+    call_trace_service.set_adaptive_buffer_sizing(true);
+  std::wstring budget_str(cmd_line->GetSwitchValueNative(
+      "buffer-memory-budget"));
+  if (!budget_str.empty()) {
+    int num = 0;
+    if (!base::StringToInt(budget_str, &num) || num < 1 ||
+        num > kMaxBufferMemoryBudgetMb) {
+      LOG(ERROR) << "The buffer memory budget must be between 1 and "
+                 << kMaxBufferMemoryBudgetMb << " MB.";
+      return false;
+    }
+    call_trace_service.set_buffer_memory_budget(
+        static_cast<size_t>(num) * 1024 * 1024);
+  }
+
+  // Setup the overload policy.
+  std::string overload_str(cmd_line->GetSwitchValueASCII("overload-policy"));
+  if (overload_str == "drop") {
+    call_trace_service.set_overload_policy(Service::kDropBuffersOnOverload);
+  } else if (!overload_str.empty() && overload_str != "wait") {
+    LOG(ERROR) << "Unknown overload policy '" << overload_str << "'.";
+    return false;
+  }
+
+  // Setup clock sampling.
+  call_trace_service.set_clock_sample_interval_ms(
+      Service::kDefaultClockSampleIntervalMs);
+  std::wstring interval_str(cmd_line->GetSwitchValueNative(
+      "clock-sample-interval"));
+  if (!interval_str.empty()) {
+    int num = 0;
+    if (!base::StringToInt(interval_str, &num) || num < 0 ||
+        num > kMaxClockSampleIntervalMs) {
+      LOG(ERROR) << "The clock sample interval must be between 0 and "
+                 << kMaxClockSampleIntervalMs << " ms.";
+      return false;
+    }
+    call_trace_service.set_clock_sample_interval_ms(num);
+  }
+
   if (cmd_line->HasSwitch("enable-exits")) {
     call_trace_service.set_flags(TRACE_FLAG_ENTER | TRACE_FLAG_EXIT);
   }
@@ -84,6 +84,16 @@ boolean CallTraceService_CloseSession(
   return true;
 }
 
+// RPC entrypoint for CallTraceService::CreateExchangeRing().
+boolean CallTraceService_CreateExchangeRing(
+    /* [in] */ SessionHandle session_handle,
+    /* [out] */ unsigned long* ring_handle,
+    /* [out] */ unsigned long* event_handle) {
+  Service* instance = RpcServiceInstanceManager::GetInstance();
+  return instance->CreateExchangeRing(session_handle, ring_handle,
+                                      event_handle);
+}
+
 // RPC entrypoint for CallTraceControl::Stop().
 boolean CallTraceService_Stop(/* [in] */ handle_t /* binding */) {
   Service* instance = RpcServiceInstanceManager::GetInstance();
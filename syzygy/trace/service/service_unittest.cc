@@ -17,6 +17,9 @@
 #include <psapi.h>
 #include <userenv.h>
 
+#include <algorithm>
+
+#include "base/bind.h"
 #include "base/command_line.h"
 #include "base/environment.h"
 #include "base/file_util.h"
@@ -26,6 +29,7 @@
 #include "base/utf_string_conversions.h"
 #include "base/files/scoped_temp_dir.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/synchronization/waitable_event.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/common/align.h"
@@ -56,6 +60,12 @@ size_t RoundedSize(const TraceFileHeader& header) {
   return AlignUp(header.header_size, header.block_size);
 }
 
+// Collects the paths of the trace file chunks as they are completed.
+void AppendPath(std::vector<base::FilePath>* paths,
+                const base::FilePath& path) {
+  paths->push_back(path);
+}
+
 class ScopedEnvironment {
  public:
   ScopedEnvironment() {
@@ -291,6 +301,15 @@ class CallTraceServiceTest : public testing::Test {
     ASSERT_TRUE(file_util::ReadFileToString(trace_file_name, contents));
   }
 
+  // Waits for the tasks already posted to the consumer thread to run.
+  void FlushConsumerThread() {
+    base::WaitableEvent event(true, false);
+    consumer_thread_.message_loop()->PostTask(
+        FROM_HERE,
+        base::Bind(&base::WaitableEvent::Signal, base::Unretained(&event)));
+    event.Wait();
+  }
+
   void ValidateTraceFileHeader(const TraceFileHeader& header) {
     std::wstring cmd_line(::GetCommandLineW());
 
@@ -520,6 +539,59 @@ TEST_F(CallTraceServiceTest, Connect) {
             RoundedSize(*header) + header->block_size);
 }
 
+TEST_F(CallTraceServiceTest, ClockSamples) {
+  SessionHandle session_handle = NULL;
+  TraceFileSegment segment;
+
+  // Use an interval long enough for the session to only get the clock sample
+  // written on its creation.
+  call_trace_service_.set_clock_sample_interval_ms(60 * 1000);
+  ASSERT_TRUE(call_trace_service_.Start(true));
+  ASSERT_NO_FATAL_FAILURE(CreateSession(&session_handle, &segment));
+  ASSERT_TRUE(call_trace_service_.Stop());
+
+  std::string trace_file_contents;
+  ASSERT_NO_FATAL_FAILURE(ReadTraceFile(&trace_file_contents));
+
+  // We expect the header, a block containing the clock sample and a block
+  // containing the process ended event.
+  TraceFileHeader* header =
+      reinterpret_cast<TraceFileHeader*>(&trace_file_contents[0]);
+  ASSERT_NO_FATAL_FAILURE(ValidateTraceFileHeader(*header));
+  ASSERT_EQ(trace_file_contents.length(),
+            RoundedSize(*header) + 2 * header->block_size);
+
+  // Locate and validate the segment header of the clock sample.
+  size_t segment_offset = RoundedSize(*header);
+  RecordPrefix* prefix = reinterpret_cast<RecordPrefix*>(
+      &trace_file_contents[0] + segment_offset);
+  ASSERT_EQ(TraceFileSegmentHeader::kTypeId, prefix->type);
+  TraceFileSegmentHeader* segment_header =
+      reinterpret_cast<TraceFileSegmentHeader*>(prefix + 1);
+  ASSERT_EQ(sizeof(RecordPrefix) + sizeof(TraceClockSample),
+            segment_header->segment_length);
+  ASSERT_EQ(0, segment_header->thread_id);
+
+  // Validate the clock sample.
+  prefix = reinterpret_cast<RecordPrefix*>(segment_header + 1);
+  ASSERT_EQ(TRACE_CLOCK_SAMPLE, prefix->type);
+  ASSERT_EQ(sizeof(TraceClockSample), prefix->size);
+  TraceClockSample* clock_sample =
+      reinterpret_cast<TraceClockSample*>(prefix + 1);
+  EXPECT_EQ(trace::common::GetQpcFrequency(), clock_sample->qpc_frequency);
+  EXPECT_LE(clock_sample->reference.qpc, clock_sample->sample.qpc);
+  EXPECT_LE(clock_sample->reference.tsc, clock_sample->sample.tsc);
+
+  // The process ended event follows in the next block.
+  segment_offset += header->block_size;
+  prefix = reinterpret_cast<RecordPrefix*>(
+      &trace_file_contents[0] + segment_offset);
+  ASSERT_EQ(TraceFileSegmentHeader::kTypeId, prefix->type);
+  segment_header = reinterpret_cast<TraceFileSegmentHeader*>(prefix + 1);
+  prefix = reinterpret_cast<RecordPrefix*>(segment_header + 1);
+  ASSERT_EQ(TRACE_PROCESS_ENDED, prefix->type);
+}
+
 TEST_F(CallTraceServiceTest, Allocate) {
   SessionHandle session_handle = NULL;
   TraceFileSegment segment1;
@@ -812,5 +884,84 @@ TEST_F(CallTraceServiceTest, SendBuffer) {
             RawPtrDiff(prefix + 1, segment_header + 1));
 }
 
+TEST_F(CallTraceServiceTest, RotateTraceFile) {
+  // Rotate the trace file before each segment.
+  std::vector<base::FilePath> chunk_paths;
+  session_trace_file_writer_factory_.set_max_chunk_size(1);
+  session_trace_file_writer_factory_.set_chunk_callback(
+      base::Bind(&AppendPath, base::Unretained(&chunk_paths)));
+
+  SessionHandle session_handle = NULL;
+  TraceFileSegment segment;
+  ASSERT_TRUE(call_trace_service_.Start(true));
+  ASSERT_NO_FATAL_FAILURE(CreateSession(&session_handle, &segment));
+
+  // Load a module in the first segment, and log messages in the others.
+  const ModuleAddr kModuleBase = reinterpret_cast<ModuleAddr>(0x10000000);
+  const size_t kNumSegments = 3;
+  for (size_t i = 0; i < kNumSegments; ++i) {
+    segment.WriteSegmentHeader(session_handle);
+    if (i == 0) {
+      TraceModuleData* module_data = reinterpret_cast<TraceModuleData*>(
+          segment.AllocateTraceRecordImpl(TRACE_PROCESS_ATTACH_EVENT,
+                                          sizeof(TraceModuleData)));
+      module_data->module_base_addr = kModuleBase;
+      module_data->module_base_size = 0x1000;
+      base::wcslcpy(module_data->module_name, L"module.dll",
+                    arraysize(module_data->module_name));
+    } else {
+      MyRecordType* record = segment.AllocateTraceRecord<MyRecordType>();
+      base::strlcpy(record->message, "Hello", arraysize(record->message));
+    }
+    ASSERT_NO_FATAL_FAILURE(ExchangeBuffer(session_handle, &segment));
+  }
+  ASSERT_NO_FATAL_FAILURE(ReturnBuffer(session_handle, &segment));
+  ASSERT_NO_FATAL_FAILURE(CloseSession(&session_handle));
+  ASSERT_TRUE(call_trace_service_.Stop());
+  FlushConsumerThread();
+
+  // There is a chunk per segment, plus one for the process ended event. The
+  // chunks are numbered, so they sort in order.
+  ASSERT_EQ(kNumSegments + 1, chunk_paths.size());
+  std::sort(chunk_paths.begin(), chunk_paths.end());
+  for (size_t i = 0; i < chunk_paths.size(); ++i) {
+    SCOPED_TRACE(chunk_paths[i].value());
+    EXPECT_NE(std::wstring::npos, chunk_paths[i].value().find(
+        base::StringPrintf(L"-chunk-%04d", i)));
+
+    // Each chunk is a trace file in its own right.
+    std::string contents;
+    ASSERT_TRUE(file_util::ReadFileToString(chunk_paths[i], &contents));
+    ASSERT_LE(sizeof(TraceFileHeader), contents.size());
+    const TraceFileHeader* header =
+        reinterpret_cast<const TraceFileHeader*>(&contents[0]);
+    ASSERT_NO_FATAL_FAILURE(ValidateTraceFileHeader(*header));
+    if (i == 0)
+      continue;
+
+    // The later chunks start by replaying the module attach event.
+    size_t offset = RoundedSize(*header);
+    const size_t kEventSize = sizeof(RecordPrefix) + sizeof(TraceModuleData);
+    ASSERT_LT(offset + sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader) +
+                  kEventSize,
+              contents.size());
+    const RecordPrefix* prefix =
+        reinterpret_cast<const RecordPrefix*>(&contents[offset]);
+    ASSERT_EQ(TraceFileSegmentHeader::kTypeId, prefix->type);
+    const TraceFileSegmentHeader* segment_header =
+        reinterpret_cast<const TraceFileSegmentHeader*>(prefix + 1);
+    EXPECT_EQ(0, segment_header->thread_id);
+    EXPECT_EQ(kEventSize, segment_header->segment_length);
+
+    prefix = reinterpret_cast<const RecordPrefix*>(segment_header + 1);
+    ASSERT_EQ(TRACE_PROCESS_ATTACH_EVENT, prefix->type);
+    ASSERT_EQ(sizeof(TraceModuleData), prefix->size);
+    const TraceModuleData* module_data =
+        reinterpret_cast<const TraceModuleData*>(prefix + 1);
+    EXPECT_EQ(kModuleBase, module_data->module_base_addr);
+    EXPECT_STREQ(L"module.dll", module_data->module_name);
+  }
+}
+
 }  // namespace service
 }  // namespace trace
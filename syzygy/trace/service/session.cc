@@ -24,6 +24,8 @@
 
 #include <time.h>
 
+#include <algorithm>
+
 #include "base/command_line.h"
 #include "base/logging.h"
 #include "base/string_util.h"
@@ -50,15 +52,73 @@ std::ostream& operator << (std::ostream& stream, const Buffer::ID& buffer_id) {
                 << ", buffer_offset=0x" << std::hex << buffer_id.second;
 }
 
+// Converts between buffer exchange ring entries and call trace buffers.
+// @{
+void ToExchangeEntry(const CallTraceBuffer& buffer,
+                     BufferExchangeEntry* entry) {
+  DCHECK(entry != NULL);
+  entry->shared_memory_handle = buffer.shared_memory_handle;
+  entry->mapping_size = buffer.mapping_size;
+  entry->buffer_offset = buffer.buffer_offset;
+  entry->buffer_size = buffer.buffer_size;
+}
+
+void FromExchangeEntry(const BufferExchangeEntry& entry,
+                       CallTraceBuffer* buffer) {
+  DCHECK(buffer != NULL);
+  buffer->shared_memory_handle = entry.shared_memory_handle;
+  buffer->mapping_size = entry.mapping_size;
+  buffer->buffer_offset = entry.buffer_offset;
+  buffer->buffer_size = entry.buffer_size;
+}
+// @}
+
+// Writes an empty segment to @p buffer, so that it is written to the trace
+// file without contributing any content.
+bool WriteEmptySegment(Buffer* buffer) {
+  DCHECK(buffer != NULL);
+
+  if (buffer->buffer_size <
+          sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader)) {
+    LOG(ERROR) << "Buffer too small for an empty segment.";
+    return false;
+  }
+
+  MappedBuffer mapped_buffer(buffer);
+  if (!mapped_buffer.Map())
+    return false;
+
+  RecordPrefix* segment_prefix =
+      reinterpret_cast<RecordPrefix*>(mapped_buffer.data());
+  segment_prefix->timestamp = trace::common::GetTsc();
+  segment_prefix->size = sizeof(TraceFileSegmentHeader);
+  segment_prefix->type = TraceFileSegmentHeader::kTypeId;
+  segment_prefix->version.hi = TRACE_VERSION_HI;
+  segment_prefix->version.lo = TRACE_VERSION_LO;
+
+  TraceFileSegmentHeader* segment_header =
+      reinterpret_cast<TraceFileSegmentHeader*>(segment_prefix + 1);
+  segment_header->thread_id = 0;
+  segment_header->segment_length = 0;
+
+  return true;
+}
+
 }  // namespace
 
 Session::Session(Service* call_trace_service)
     : call_trace_service_(call_trace_service),
       is_closing_(false),
       buffer_consumer_(NULL),
+      adaptive_buffer_size_(0),
+      buffer_requests_in_sampling_period_(0),
       buffer_requests_waiting_for_recycle_(0),
+      num_buffers_dropped_(0),
+      num_bytes_dropped_(0),
       buffer_is_available_(&lock_),
       buffer_id_(0),
+      exchange_ring_(NULL),
+      exchange_ring_wait_(NULL),
       input_error_already_logged_(false) {
   DCHECK(call_trace_service != NULL);
   ::memset(buffer_state_counts_, 0, sizeof(buffer_state_counts_));
@@ -70,6 +130,8 @@ Session::~Session() {
   // We expect all of the buffers to be available, and none of them to be
   // outstanding.
   DCHECK(call_trace_service_ != NULL);
+  DCHECK(exchange_ring_wait_ == NULL);
+  DCHECK(exchange_ring_ == NULL);
   DCHECK_EQ(buffers_available_.size(),
             buffer_state_counts_[Buffer::kAvailable]);
   DCHECK_EQ(buffers_.size(), buffer_state_counts_[Buffer::kAvailable]);
@@ -86,8 +148,10 @@ Session::~Session() {
   while (!shared_memory_buffers_.empty()) {
     BufferPool* pool = shared_memory_buffers_.back();
     shared_memory_buffers_.pop_back();
+    call_trace_service_->RemoveBufferMemory(pool->begin()->mapping_size);
     delete pool;
   }
+  singleton_pools_.clear();
 
   // TODO(rogerm): Perhaps this code should be tied to the last recycled buffer
   //     after is_closing_ (see RecycleBuffer()). It is bothersome to tie logic
@@ -110,6 +174,10 @@ bool Session::Init(ProcessId client_process_id) {
 }
 
 bool Session::Close() {
+  // This must happen before we start flushing buffers, and without holding
+  // lock_, as the ring's wait callbacks acquire it.
+  CloseExchangeRing();
+
   std::vector<Buffer*> buffers;
   base::AutoLock lock(lock_);
 
@@ -135,9 +203,17 @@ bool Session::Close() {
     }
   }
 
+  // Account for the buffers dropped since the backlog last cleared.
+  Buffer* buffer = NULL;
+  if (num_buffers_dropped_ != 0 && CreateBuffersDroppedEvent(&buffer)) {
+    DCHECK(buffer != NULL);
+    ChangeBufferState(Buffer::kPendingWrite, buffer);
+    buffer_consumer_->ConsumeBuffer(buffer);
+    buffer = NULL;
+  }
+
   // Create a process ended event. This causes at least one buffer to be in
   // use to store the process ended event.
-  Buffer* buffer = NULL;
   if (CreateProcessEndedEvent(&buffer)) {
     DCHECK(buffer != NULL);
     ChangeBufferState(Buffer::kPendingWrite, buffer);
@@ -147,6 +223,37 @@ bool Session::Close() {
   return true;
 }
 
+bool Session::WriteClockSample(const TraceClockSample& clock_sample) {
+  base::AutoLock lock(lock_);
+
+  // A closing session has already written its process ended event, which
+  // must be the last event of the trace.
+  if (is_closing_)
+    return true;
+
+  DCHECK(buffer_consumer_.get() != NULL);
+
+  // Allocate a regular pool if need be, as the buffer will be recycled for use
+  // by the client. This never waits on back-pressure.
+  if (buffers_available_.empty() &&
+      !AllocateBuffers(call_trace_service_->num_incremental_buffers(),
+                       GetPoolBufferSize())) {
+    return false;
+  }
+
+  Buffer* buffer = NULL;
+  if (!CreateEventBuffer(TRACE_CLOCK_SAMPLE, &clock_sample,
+                         sizeof(clock_sample), &buffer)) {
+    return false;
+  }
+  DCHECK(buffer != NULL);
+
+  ChangeBufferState(Buffer::kPendingWrite, buffer);
+  buffer_consumer_->ConsumeBuffer(buffer);
+
+  return true;
+}
+
 bool Session::FindBuffer(CallTraceBuffer* call_trace_buffer,
                          Buffer** client_buffer) {
   DCHECK(call_trace_buffer != NULL);
@@ -179,6 +286,81 @@ bool Session::FindBuffer(CallTraceBuffer* call_trace_buffer,
   return true;
 }
 
+bool Session::CreateExchangeRing(HANDLE* client_ring_handle,
+                                 HANDLE* client_event_handle) {
+  DCHECK(client_ring_handle != NULL);
+  DCHECK(client_event_handle != NULL);
+
+  {
+    base::AutoLock lock(exchange_ring_lock_);
+
+    if (exchange_ring_ != NULL) {
+      LOG(ERROR) << "The session already has a buffer exchange ring.";
+      return false;
+    }
+
+    base::win::ScopedHandle mapping(::CreateFileMapping(
+        INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+        sizeof(BufferExchangeRing), NULL));
+    if (!mapping.IsValid()) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to allocate buffer exchange ring: "
+                 << com::LogWe(error) << ".";
+      return false;
+    }
+
+    // The fresh mapping is zeroed, which is an empty ring.
+    void* view = ::MapViewOfFile(mapping.Get(), FILE_MAP_WRITE, 0, 0,
+                                 sizeof(BufferExchangeRing));
+    if (view == NULL) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to map buffer exchange ring: "
+                 << com::LogWe(error) << ".";
+      return false;
+    }
+
+    base::win::ScopedHandle event(::CreateEvent(NULL, FALSE, FALSE, NULL));
+    if (!event.IsValid()) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to create buffer exchange ring event: "
+                 << com::LogWe(error) << ".";
+      ::UnmapViewOfFile(view);
+      return false;
+    }
+
+    if (!CopyBufferHandleToClient(client_.process_handle.Get(),
+                                  mapping.Get(),
+                                  client_ring_handle) ||
+        !CopyBufferHandleToClient(client_.process_handle.Get(),
+                                  event.Get(),
+                                  client_event_handle)) {
+      ::UnmapViewOfFile(view);
+      return false;
+    }
+
+    HANDLE wait = NULL;
+    if (!::RegisterWaitForSingleObject(&wait, event.Get(),
+                                       &OnExchangeRingSignaled, this,
+                                       INFINITE, WT_EXECUTEDEFAULT)) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to wait on buffer exchange ring event: "
+                 << com::LogWe(error) << ".";
+      ::UnmapViewOfFile(view);
+      return false;
+    }
+
+    exchange_ring_mapping_.Set(mapping.Take());
+    exchange_ring_event_.Set(event.Take());
+    exchange_ring_ = reinterpret_cast<BufferExchangeRing*>(view);
+    exchange_ring_wait_ = wait;
+  }
+
+  // Offer the client a first batch of buffers.
+  ServiceExchangeRing(true);
+
+  return true;
+}
+
 bool Session::GetNextBuffer(Buffer** out_buffer) {
   return GetBuffer(0, out_buffer);
 }
@@ -212,6 +394,7 @@ bool Session::ReturnBuffer(Buffer* buffer) {
   DCHECK(buffer != NULL);
   DCHECK(buffer->session == this);
 
+  Buffer* dropped_event_buffer = NULL;
   {
     base::AutoLock lock(lock_);
 
@@ -221,6 +404,36 @@ bool Session::ReturnBuffer(Buffer* buffer) {
       return true;
 
     ChangeBufferState(Buffer::kPendingWrite, buffer);
+
+    // If the writers have fallen behind and the policy allows it, drop the
+    // buffer rather than growing the backlog. It goes straight back to the
+    // available buffers, so buffer requests needn't wait for the writers.
+    // Singleton buffers are never dropped, they're destroyed once written.
+    if (call_trace_service_->overload_policy() ==
+            Service::kDropBuffersOnOverload &&
+        buffer_state_counts_[Buffer::kPendingWrite] >
+            call_trace_service_->max_buffers_pending_write() &&
+        singleton_pools_.count(buffer->pool) == 0) {
+      ChangeBufferState(Buffer::kAvailable, buffer);
+      buffers_available_.push_front(buffer);
+      buffer_is_available_.Signal();
+      ++num_buffers_dropped_;
+      num_bytes_dropped_ += buffer->buffer_size;
+      return true;
+    }
+
+    // The backlog has room again, so account for the buffers dropped in the
+    // meantime. This goes ahead of the buffer, which was filled after them.
+    if (num_buffers_dropped_ != 0 &&
+        CreateBuffersDroppedEvent(&dropped_event_buffer)) {
+      DCHECK(dropped_event_buffer != NULL);
+      ChangeBufferState(Buffer::kPendingWrite, dropped_event_buffer);
+    }
+  }
+
+  if (dropped_event_buffer != NULL &&
+      !buffer_consumer_->ConsumeBuffer(dropped_event_buffer)) {
+    LOG(ERROR) << "Unable to schedule buffers dropped event for writing.";
   }
 
   // Hand the buffer over to the consumer.
@@ -237,13 +450,14 @@ bool Session::RecycleBuffer(Buffer* buffer) {
   DCHECK(buffer->session == this);
 
   // Is this a special singleton buffer? If so, we don't want to return it to
-  // the pool but rather destroy it immediately.
-  size_t normal_buffer_size = ::common::AlignUp(
-      call_trace_service_->buffer_size_in_bytes(),
-      buffer_consumer_->block_size());
-  if (buffer->buffer_offset == 0 &&
-      buffer->mapping_size == buffer->buffer_size &&
-      buffer->buffer_size > normal_buffer_size) {
+  // the pool but rather destroy it immediately. With adaptive buffer sizing
+  // regular buffers may be as big as singletons, so we can't go by size.
+  bool is_singleton = false;
+  {
+    base::AutoLock lock(lock_);
+    is_singleton = singleton_pools_.count(buffer->pool) != 0;
+  }
+  if (is_singleton) {
     if (!DestroySingletonBuffer(buffer))
       return false;
     return true;
@@ -371,6 +585,7 @@ bool Session::AllocateBufferPool(
   pool->SetClientHandle(client_handle);
 
   // Save the shared memory block so that it's managed by the session.
+  call_trace_service_->AddBufferMemory(num_buffers * buffer_size);
   shared_memory_buffers_.push_back(pool.get());
   *out_pool = pool.release();
 
@@ -420,6 +635,7 @@ bool Session::AllocateBufferForImmediateUse(size_t minimum_size,
 
   // Get the buffer.
   DCHECK_EQ(pool_ptr->begin() + 1, pool_ptr->end());
+  singleton_pools_.insert(pool_ptr);
   Buffer* buffer = pool_ptr->begin();
   Buffer::ID buffer_id = Buffer::GetID(*buffer);
 
@@ -441,6 +657,9 @@ bool Session::GetNextBufferUnlocked(Buffer** out_buffer) {
 
   *out_buffer = NULL;
 
+  if (call_trace_service_->adaptive_buffer_sizing())
+    UpdateAdaptiveBufferSize(base::TimeTicks::Now());
+
   // If we have too many pending writes, let's wait until one of those has
   // been completed and recycle that buffer. This provides some back-pressure
   // on our allocation mechanism.
@@ -460,6 +679,11 @@ bool Session::GetNextBufferUnlocked(Buffer** out_buffer) {
   // We have to be careful that we don't pile up arbitrary many threads waiting
   // for a finite number of buffers that will be recycled. Hence, we count the
   // number of requests applying back-pressure.
+  //
+  // Under the kDropBuffersOnOverload policy we never wait: ReturnBuffer keeps
+  // the backlog in check by dropping buffers instead.
+  bool may_wait = call_trace_service_->overload_policy() ==
+      Service::kWaitOnOverload;
   while (buffers_available_.empty()) {
     // Figure out how many buffers we can force to be recycled according to our
     // threshold and the number of write-pending buffers.
@@ -474,7 +698,8 @@ bool Session::GetNextBufferUnlocked(Buffer** out_buffer) {
     // This will either force us to wait until a buffer has been written and
     // recycled, or if the request volume is high enough we'll likely be
     // satisfied by an allocation.
-    if (buffer_requests_waiting_for_recycle_ < buffers_force_recyclable) {
+    if (may_wait &&
+        buffer_requests_waiting_for_recycle_ < buffers_force_recyclable) {
       ++buffer_requests_waiting_for_recycle_;
       OnWaitingForBufferToBeRecycled();  // Unittest hook.
       buffer_is_available_.Wait();
@@ -482,7 +707,7 @@ bool Session::GetNextBufferUnlocked(Buffer** out_buffer) {
     } else {
       // Otherwise, force an allocation.
       if (!AllocateBuffers(call_trace_service_->num_incremental_buffers(),
-                           call_trace_service_->buffer_size_in_bytes())) {
+                           GetPoolBufferSize())) {
         return false;
       }
     }
@@ -531,6 +756,8 @@ bool Session::DestroySingletonBuffer(Buffer* buffer) {
 
   // Remove the pool from our collection of pools.
   shared_memory_buffers_.erase(it);
+  singleton_pools_.erase(pool);
+  call_trace_service_->RemoveBufferMemory(pool->begin()->mapping_size);
 
   // Remove the buffer from the buffer map.
   CHECK_EQ(1u, buffers_.erase(Buffer::GetID(*buffer)));
@@ -545,30 +772,126 @@ bool Session::DestroySingletonBuffer(Buffer* buffer) {
   return true;
 }
 
+void Session::UpdateAdaptiveBufferSize(base::TimeTicks now) {
+  lock_.AssertAcquired();
+
+  size_t block_size = buffer_consumer_->block_size();
+  size_t min_size = ::common::AlignUp(
+      call_trace_service_->buffer_size_in_bytes(), block_size);
+  size_t max_size = std::max(min_size, ::common::AlignUp(
+      call_trace_service_->max_buffer_size_in_bytes(), block_size));
+
+  if (adaptive_buffer_size_ == 0) {
+    adaptive_buffer_size_ = min_size;
+    sampling_period_start_ = now;
+    buffer_requests_in_sampling_period_ = 0;
+  }
+
+  ++buffer_requests_in_sampling_period_;
+  int64 elapsed_ms = (now - sampling_period_start_).InMilliseconds();
+  if (elapsed_ms < kAdaptiveSamplingPeriodMs)
+    return;
+
+  uint64 requests_per_second =
+      buffer_requests_in_sampling_period_ * 1000ULL / elapsed_ms;
+  size_t new_size = adaptive_buffer_size_;
+  if (requests_per_second >= kGrowBufferRequestsPerSecond) {
+    new_size = std::min(adaptive_buffer_size_ * 2, max_size);
+  } else if (requests_per_second < kShrinkBufferRequestsPerSecond) {
+    new_size = std::max(adaptive_buffer_size_ / 2, min_size);
+  }
+
+  if (new_size != adaptive_buffer_size_) {
+    VLOG(1) << "Changing the buffer size of the session for PID="
+            << client_.process_id << " from " << adaptive_buffer_size_
+            << " to " << new_size << " bytes (" << requests_per_second
+            << " buffer requests/sec).";
+    adaptive_buffer_size_ = new_size;
+  }
+
+  sampling_period_start_ = now;
+  buffer_requests_in_sampling_period_ = 0;
+}
+
+size_t Session::GetPoolBufferSize() const {
+  lock_.AssertAcquired();
+
+  size_t buffer_size = call_trace_service_->buffer_size_in_bytes();
+  if (!call_trace_service_->adaptive_buffer_sizing() ||
+      adaptive_buffer_size_ <= buffer_size) {
+    return buffer_size;
+  }
+
+  // Growth is bounded by the global budget. Once that's exhausted we fall
+  // back to the regular size, rather than failing the allocation.
+  size_t pool_size =
+      call_trace_service_->num_incremental_buffers() * adaptive_buffer_size_;
+  if (call_trace_service_->buffer_memory_in_use() + pool_size >
+          call_trace_service_->buffer_memory_budget()) {
+    return buffer_size;
+  }
+
+  return adaptive_buffer_size_;
+}
+
 bool Session::CreateProcessEndedEvent(Buffer** buffer) {
   DCHECK(buffer != NULL);
   lock_.AssertAcquired();
 
+  return CreateEventBuffer(TRACE_PROCESS_ENDED, NULL, 0, buffer);
+}
+
+bool Session::CreateBuffersDroppedEvent(Buffer** buffer) {
+  DCHECK(buffer != NULL);
+  DCHECK_NE(0u, num_buffers_dropped_);
+  lock_.AssertAcquired();
+
+  TraceBuffersDropped buffers_dropped = {};
+  buffers_dropped.num_buffers = num_buffers_dropped_;
+  buffers_dropped.num_bytes = num_bytes_dropped_;
+  if (!CreateEventBuffer(TRACE_BUFFERS_DROPPED, &buffers_dropped,
+                         sizeof(buffers_dropped), buffer)) {
+    return false;
+  }
+
+  LOG(WARNING) << "Dropped " << num_buffers_dropped_ << " buffers ("
+               << num_bytes_dropped_ << " bytes) for PID="
+               << client_.process_id << " as the writers fell behind.";
+  num_buffers_dropped_ = 0;
+  num_bytes_dropped_ = 0;
+
+  return true;
+}
+
+bool Session::CreateEventBuffer(TraceEventType type,
+                                const void* data,
+                                size_t data_size,
+                                Buffer** buffer) {
+  DCHECK(data != NULL || data_size == 0);
+  DCHECK(buffer != NULL);
+  lock_.AssertAcquired();
+
   *buffer = NULL;
 
-  // We output a segment that contains a single empty event. That is, the
-  // event consists only of a prefix whose data size is set to zero. The buffer
-  // will be populated with the following:
+  // We output a segment that contains a single event. The buffer will be
+  // populated with the following:
   //
   // RecordPrefix: the prefix for the TraceFileSegmentHeader which follows
   //     (with type TraceFileSegmentHeader::kTypeId).
   // TraceFileSegmentHeader: the segment header for the segment represented
   //     by this buffer.
-  // RecordPrefix: the prefix for the event itself (with type
-  //     TRACE_PROCESS_ENDED). This prefix will have a data size of zero
-  //     indicating that no structure follows.
+  // RecordPrefix: the prefix for the event itself (with type @p type). This
+  //     prefix has a data size of @p data_size, which is zero for events that
+  //     consist only of their prefix.
+  // The event data, if any.
   const size_t kBufferSize = sizeof(RecordPrefix) +
-      sizeof(TraceFileSegmentHeader) + sizeof(RecordPrefix);
+      sizeof(TraceFileSegmentHeader) + sizeof(RecordPrefix) + data_size;
 
   // Ensure that a free buffer exists.
   if (buffers_available_.empty()) {
     if (!AllocateBuffers(1, kBufferSize)) {
-      LOG(ERROR) << "Unable to allocate buffer for process ended event.";
+      LOG(ERROR) << "Unable to allocate buffer for event of type " << type
+                 << ".";
       return false;
     }
   }
@@ -576,7 +899,7 @@ bool Session::CreateProcessEndedEvent(Buffer** buffer) {
 
   // Get a buffer for the event.
   if (!GetNextBufferUnlocked(buffer) || *buffer == NULL) {
-    LOG(ERROR) << "Unable to get a buffer for process ended event.";
+    LOG(ERROR) << "Unable to get a buffer for event of type " << type << ".";
     return false;
   }
   DCHECK(*buffer != NULL);
@@ -584,7 +907,7 @@ bool Session::CreateProcessEndedEvent(Buffer** buffer) {
   // This should pretty much never happen as we always allocate really big
   // buffers, but it is possible.
   if ((*buffer)->buffer_size < kBufferSize) {
-    LOG(ERROR) << "Buffer too small for process ended event.";
+    LOG(ERROR) << "Buffer too small for event of type " << type << ".";
     return false;
   }
 
@@ -606,19 +929,143 @@ bool Session::CreateProcessEndedEvent(Buffer** buffer) {
   TraceFileSegmentHeader* segment_header =
       reinterpret_cast<TraceFileSegmentHeader*>(segment_prefix + 1);
   segment_header->thread_id = 0;
-  segment_header->segment_length = sizeof(RecordPrefix);
+  segment_header->segment_length = sizeof(RecordPrefix) + data_size;
 
   RecordPrefix* event_prefix =
       reinterpret_cast<RecordPrefix*>(segment_header + 1);
   event_prefix->timestamp = timestamp;
-  event_prefix->size = 0;
-  event_prefix->type = TRACE_PROCESS_ENDED;
+  event_prefix->size = data_size;
+  event_prefix->type = type;
   event_prefix->version.hi = TRACE_VERSION_HI;
   event_prefix->version.lo = TRACE_VERSION_LO;
 
+  if (data_size != 0)
+    ::memcpy(event_prefix + 1, data, data_size);
+
   return true;
 }
 
+void Session::ServiceExchangeRing(bool refill) {
+  base::AutoLock exchange_ring_lock(exchange_ring_lock_);
+
+  if (exchange_ring_ == NULL)
+    return;
+
+  // Return the buffers the client has committed. FindBuffer takes care of
+  // logging bogus entries, which we otherwise ignore.
+  BufferExchangeEntry entry = {};
+  while (exchange_ring_->committed.Pop(&entry)) {
+    CallTraceBuffer call_trace_buffer = {};
+    FromExchangeEntry(entry, &call_trace_buffer);
+    Buffer* buffer = NULL;
+    if (!FindBuffer(&call_trace_buffer, &buffer))
+      continue;
+    if (!ReturnBuffer(buffer))
+      LOG(ERROR) << "Unable to return committed buffer to session.";
+  }
+
+  if (!refill)
+    return;
+
+  size_t depth = exchange_ring_->available.size();
+  if (depth >= kExchangeRingRefillDepth)
+    return;
+
+  std::vector<Buffer*> buffers;
+  GetBuffersForExchangeRing(kExchangeRingRefillDepth - depth, &buffers);
+  for (size_t i = 0; i < buffers.size(); ++i) {
+    ToExchangeEntry(*buffers[i], &entry);
+    // We're the sole producer and stay well below the capacity, so this can
+    // only fail if the client has corrupted the queue.
+    if (!exchange_ring_->available.Push(entry)) {
+      LOG(ERROR) << "The buffer exchange ring is corrupt.";
+      // Hand the buffers back for writing, lest they leak.
+      for (; i < buffers.size(); ++i) {
+        if (WriteEmptySegment(buffers[i]))
+          ReturnBuffer(buffers[i]);
+      }
+      break;
+    }
+  }
+}
+
+VOID CALLBACK Session::OnExchangeRingSignaled(PVOID context,
+                                              BOOLEAN timed_out) {
+  DCHECK(context != NULL);
+  DCHECK(!timed_out);
+  reinterpret_cast<Session*>(context)->ServiceExchangeRing(true);
+}
+
+void Session::GetBuffersForExchangeRing(size_t max_buffers,
+                                        std::vector<Buffer*>* buffers) {
+  DCHECK(buffers != NULL);
+
+  base::AutoLock lock(lock_);
+
+  if (is_closing_)
+    return;
+
+  // Leave it to GetNextBuffer to wait on or allocate buffers in the face of
+  // back-pressure.
+  if (buffer_state_counts_[Buffer::kPendingWrite] >
+          call_trace_service_->max_buffers_pending_write()) {
+    return;
+  }
+
+  while (buffers->size() < max_buffers && !buffers_available_.empty()) {
+    Buffer* buffer = buffers_available_.front();
+    buffers_available_.pop_front();
+    ChangeBufferState(Buffer::kInUse, buffer);
+    buffers->push_back(buffer);
+  }
+}
+
+void Session::CloseExchangeRing() {
+  HANDLE wait = NULL;
+  {
+    base::AutoLock exchange_ring_lock(exchange_ring_lock_);
+    std::swap(wait, exchange_ring_wait_);
+  }
+  if (wait == NULL)
+    return;
+
+  // Wait for any callbacks in flight to complete.
+  if (!::UnregisterWaitEx(wait, INVALID_HANDLE_VALUE)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to unregister buffer exchange ring wait: "
+               << com::LogWe(error) << ".";
+  }
+
+  // Pick up whatever the client managed to commit in the meantime.
+  ServiceExchangeRing(false);
+
+  base::AutoLock exchange_ring_lock(exchange_ring_lock_);
+  DCHECK(exchange_ring_ != NULL);
+
+  // The buffers still in the available queue are in use as far as we're
+  // concerned, and will be flushed along with the others. They hold stale
+  // content though, so we reduce them to empty segments. The client can't
+  // safely have picked one up at this point, just as it can't safely keep
+  // writing to the buffers it holds.
+  BufferExchangeQueue& available = exchange_ring_->available;
+  size_t depth = available.size();
+  uint32 tail = base::subtle::Acquire_Load(&available.tail);
+  for (size_t i = 0; i < depth; ++i) {
+    CallTraceBuffer call_trace_buffer = {};
+    FromExchangeEntry(
+        available.entries[(tail + i) % BufferExchangeQueue::kCapacity],
+        &call_trace_buffer);
+    Buffer* buffer = NULL;
+    if (FindBuffer(&call_trace_buffer, &buffer))
+      WriteEmptySegment(buffer);
+  }
+
+  ::UnmapViewOfFile(exchange_ring_);
+  exchange_ring_ = NULL;
+  exchange_ring_event_.Close();
+  exchange_ring_mapping_.Close();
+}
+
 bool Session::BufferBookkeepingIsConsistent() const {
   lock_.AssertAcquired();
 
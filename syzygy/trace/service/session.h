@@ -20,6 +20,8 @@
 
 #include <list>
 #include <map>
+#include <set>
+#include <vector>
 
 #include "base/basictypes.h"
 #include "base/process.h"
@@ -28,7 +30,10 @@
 #include "base/memory/scoped_ptr.h"
 #include "base/synchronization/condition_variable.h"
 #include "base/synchronization/lock.h"
+#include "base/time.h"
 #include "base/win/scoped_handle.h"
+#include "syzygy/trace/protocol/buffer_exchange_ring.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
 #include "syzygy/trace/service/buffer_consumer.h"
 #include "syzygy/trace/service/buffer_pool.h"
 #include "syzygy/trace/service/process_info.h"
@@ -47,6 +52,24 @@ class Session : public base::RefCountedThreadSafe<Session> {
  public:
   typedef base::ProcessId ProcessId;
 
+  // @name Adaptive buffer sizing parameters. These only apply if the service
+  //     has adaptive buffer sizing enabled.
+  // @{
+  // The period (in milliseconds) over which the rate at which the client
+  // requests buffers is sampled.
+  static const int kAdaptiveSamplingPeriodMs = 1000;
+  // The buffer size is doubled for clients requesting at least this many
+  // buffers per second.
+  static const size_t kGrowBufferRequestsPerSecond = 16;
+  // The buffer size is halved for clients requesting fewer than this many
+  // buffers per second.
+  static const size_t kShrinkBufferRequestsPerSecond = 1;
+  // @}
+
+  // The number of fresh buffers the session tries to keep in the available
+  // queue of its buffer exchange ring.
+  static const size_t kExchangeRingRefillDepth = 4;
+
   explicit Session(Service* call_trace_service);
 
  public:
@@ -80,7 +103,9 @@ class Session : public base::RefCountedThreadSafe<Session> {
 
   // Returns a full buffer back to the session. After being returned here the
   // session will ensure the buffer gets written to disk before being returned
-  // to service.
+  // to service. Under the kDropBuffersOnOverload policy, a buffer returned
+  // while the write backlog is full is instead recycled right away and only
+  // accounted for.
   // @param buffer the full buffer to return.
   // @returns true on success, false otherwise.
   bool ReturnBuffer(Buffer* buffer);
@@ -98,6 +123,24 @@ class Session : public base::RefCountedThreadSafe<Session> {
   bool FindBuffer(::CallTraceBuffer* call_trace_buffer,
                   Buffer** client_buffer);
 
+  // Creates the buffer exchange ring for this session, and starts servicing
+  // it. See buffer_exchange_ring.h for details.
+  // @param client_ring_handle receives the handle to the shared memory of the
+  //     ring, valid in the client process.
+  // @param client_event_handle receives the handle to the event the client
+  //     signals after committing buffers to the ring, valid in the client
+  //     process.
+  // @returns true on success, false otherwise.
+  bool CreateExchangeRing(HANDLE* client_ring_handle,
+                          HANDLE* client_event_handle);
+
+  // Writes a clock sample to the trace of this session, in a segment of its
+  // own that is handed straight to the buffer consumer. This is a no-op once
+  // the session is closing.
+  // @param clock_sample the clock sample to write.
+  // @returns true on success, false otherwise.
+  bool WriteClockSample(const TraceClockSample& clock_sample);
+
   // Returns the process id of the client process.
   ProcessId client_process_id() const { return client_.process_id; }
 
@@ -195,6 +238,18 @@ class Session : public base::RefCountedThreadSafe<Session> {
   //     a single buffer.
   bool DestroySingletonBuffer(Buffer* buffer);
 
+  // Samples the rate at which the client requests buffers, and adjusts the
+  // size of the buffers in subsequently allocated pools accordingly. This is
+  // called on each buffer request when adaptive buffer sizing is enabled.
+  // @param now the time of the buffer request.
+  // @pre Under lock_.
+  void UpdateAdaptiveBufferSize(base::TimeTicks now);
+
+  // @returns the size of the buffers to allocate for the next regular pool.
+  //     This honors the buffer memory budget of the service.
+  // @pre Under lock_.
+  size_t GetPoolBufferSize() const;
+
   // Transitions the buffer to the given state. This only updates the buffer's
   // internal state and buffer_state_counts_, but not buffers_available_.
   // DCHECKs on any attempted invalid state changes.
@@ -211,6 +266,54 @@ class Session : public base::RefCountedThreadSafe<Session> {
   // @pre Under lock_.
   bool CreateProcessEndedEvent(Buffer** buffer);
 
+  // Gets (creating if needed) a buffer and populates it with a
+  // TRACE_BUFFERS_DROPPED event accounting for the buffers dropped since the
+  // last such event, and resets the accounting.
+  // @param buffer receives a pointer to the buffer that is used.
+  // @returns true on success, false otherwise.
+  // @pre Under lock_.
+  // @pre Some buffers have been dropped.
+  bool CreateBuffersDroppedEvent(Buffer** buffer);
+
+  // Gets (creating if needed) a buffer and populates it with a segment that
+  // holds a single event.
+  // @param type the type of the event.
+  // @param data the data of the event. This may be NULL if @p data_size is 0.
+  // @param data_size the size of the data of the event.
+  // @param buffer receives a pointer to the buffer that is used.
+  // @returns true on success, false otherwise.
+  // @pre Under lock_.
+  bool CreateEventBuffer(TraceEventType type,
+                         const void* data,
+                         size_t data_size,
+                         Buffer** buffer);
+
+  // Returns the buffers committed to the exchange ring by the client, and
+  // tops up the ring's available queue with fresh buffers if @p refill is
+  // true. This never allocates nor waits: once the available buffers run out
+  // or the write queue applies back-pressure, the client falls back to
+  // requesting buffers via RPC.
+  // @param refill true iff the available queue should be topped up.
+  void ServiceExchangeRing(bool refill);
+
+  // The wait callback registered on the exchange ring event. Calls
+  // ServiceExchangeRing on the session passed as @p context.
+  static VOID CALLBACK OnExchangeRingSignaled(PVOID context, BOOLEAN timed_out);
+
+  // Moves up to @p max_buffers available buffers to the in use state, for
+  // them to be offered in the exchange ring. This honors the back-pressure of
+  // the write queue.
+  // @param max_buffers the maximum number of buffers to get.
+  // @param buffers receives the buffers.
+  void GetBuffersForExchangeRing(size_t max_buffers,
+                                 std::vector<Buffer*>* buffers);
+
+  // Stops servicing the exchange ring, if one was created, returning the
+  // buffers last committed by the client and neutralizing those the client
+  // never picked up. This is called by Close() prior to flushing the buffers,
+  // and must be called without holding lock_.
+  void CloseExchangeRing();
+
   // Returns true if the buffer book-keeping is self-consistent.
   // @pre Under lock_.
   bool BufferBookkeepingIsConsistent() const;
@@ -240,6 +343,22 @@ class Session : public base::RefCountedThreadSafe<Session> {
   typedef std::deque<Buffer*> BufferQueue;
   BufferQueue buffers_available_;  // Under lock_.
 
+  // The pools allocated for individual buffers by
+  // AllocateBufferForImmediateUse. These are destroyed rather than recycled.
+  typedef std::set<const BufferPool*> BufferPoolSet;
+  BufferPoolSet singleton_pools_;  // Under lock_.
+
+  // @name Adaptive buffer sizing state.
+  // @{
+  // The size of the buffers to allocate for regular pools. This is zero until
+  // the first buffer request is sampled.
+  size_t adaptive_buffer_size_;  // Under lock_.
+  // The start of the current sampling period, and the number of buffers
+  // requested during it.
+  base::TimeTicks sampling_period_start_;  // Under lock_.
+  size_t buffer_requests_in_sampling_period_;  // Under lock_.
+  // @}
+
   // Tracks whether this session is in the process of shutting down.
   bool is_closing_;  // Under lock_.
 
@@ -248,6 +367,14 @@ class Session : public base::RefCountedThreadSafe<Session> {
   // there are buffers to be recycled until we fall below the back-pressure cap.
   size_t buffer_requests_waiting_for_recycle_;  // Under lock_.
 
+  // @name Overload accounting. These count the buffers dropped under the
+  //     kDropBuffersOnOverload policy since the last TRACE_BUFFERS_DROPPED
+  //     event, and their total size.
+  // @{
+  size_t num_buffers_dropped_;  // Under lock_.
+  uint64 num_bytes_dropped_;  // Under lock_.
+  // @}
+
   // This condition variable is used to indicate that a buffer is available.
   base::ConditionVariable buffer_is_available_;  // Under lock_.
 
@@ -260,6 +387,21 @@ class Session : public base::RefCountedThreadSafe<Session> {
   // state.
   base::Lock lock_;
 
+  // @name Buffer exchange ring state.
+  // @{
+  // The shared memory of the ring, and our view of it.
+  base::win::ScopedHandle exchange_ring_mapping_;  // Under exchange_ring_lock_.
+  BufferExchangeRing* exchange_ring_;  // Under exchange_ring_lock_.
+  // The event signaled by the client, and the thread pool wait on it.
+  base::win::ScopedHandle exchange_ring_event_;  // Under exchange_ring_lock_.
+  HANDLE exchange_ring_wait_;  // Under exchange_ring_lock_.
+  // Serializes the servicing of the ring, so that the session is the sole
+  // consumer of the committed queue and the sole producer of the available
+  // queue. The wait callbacks may otherwise run concurrently. This is never
+  // acquired while holding lock_.
+  base::Lock exchange_ring_lock_;
+  // @}
+
   // Tracks whether or not invalid input errors have already been logged.
   // When an error of this type occurs, there will typically be numerous
   // follow-on occurrences that we don't want to log.
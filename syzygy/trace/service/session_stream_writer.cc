@@ -0,0 +1,322 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file implements the SessionStreamWriter class.
+
+#include "syzygy/trace/service/session_stream_writer.h"
+
+#include <ws2tcpip.h>
+
+#include <vector>
+
+#include "base/bind.h"
+#include "base/message_loop.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
+#include "syzygy/trace/service/buffer_pool.h"
+#include "syzygy/trace/service/mapped_buffer.h"
+#include "syzygy/trace/service/session.h"
+
+namespace trace {
+namespace service {
+
+struct SessionStreamWriter::PendingBuffer {
+  PendingBuffer(Session* session, Buffer* buffer)
+      : session(session), buffer(buffer), mapped_buffer(buffer),
+        bytes_to_send(0) {
+  }
+
+  // @returns the data to send.
+  uint8* data() {
+    return compressed_data.empty() ? mapped_buffer.data() :
+                                     &compressed_data[0];
+  }
+
+  // Keeps the session alive until the buffer has been recycled.
+  scoped_refptr<Session> session;
+  Buffer* buffer;
+  MappedBuffer mapped_buffer;
+  // The compressed segment, if the buffer was compressed.
+  std::vector<uint8> compressed_data;
+  // The number of bytes of data() to send.
+  size_t bytes_to_send;
+};
+
+SessionStreamWriter::SessionStreamWriter(base::MessageLoop* message_loop,
+                                         const std::string& host,
+                                         const std::string& port)
+    : message_loop_(message_loop),
+      host_(host),
+      port_(port),
+      socket_(INVALID_SOCKET),
+      compress_segments_(false),
+      send_posted_(false),
+      bytes_sent_(0) {
+  DCHECK(message_loop != NULL);
+  DCHECK(!host.empty());
+  DCHECK(!port.empty());
+  layout_.set_block_size(kBlockSize);
+}
+
+SessionStreamWriter::~SessionStreamWriter() {
+  DCHECK(pending_buffers_.empty());
+  if (socket_ != INVALID_SOCKET)
+    ::closesocket(socket_);
+}
+
+bool SessionStreamWriter::Open(Session* session) {
+  DCHECK(session != NULL);
+
+  if (!Connect())
+    return false;
+
+  // The header goes out right away, ahead of any buffer.
+  std::vector<uint8> header;
+  if (!TraceFileWriter::BuildHeader(session->client_info(), kBlockSize,
+                                    &header)) {
+    return false;
+  }
+  WSABUF header_buffer = { header.size(),
+                           reinterpret_cast<char*>(&header[0]) };
+  return Send(&header_buffer, 1, header.size());
+}
+
+bool SessionStreamWriter::Close(Session* /* session */) {
+  // Buffers are only recycled once they have been sent, so by the time the
+  // session closes us there is nothing left to send.
+  message_loop_->PostTask(
+      FROM_HERE, base::Bind(&SessionStreamWriter::CloseConnection, this));
+
+  return true;
+}
+
+bool SessionStreamWriter::ConsumeBuffer(Buffer* buffer) {
+  DCHECK(buffer != NULL);
+  DCHECK(buffer->session != NULL);
+
+  message_loop_->PostTask(FROM_HERE,
+                          base::Bind(&SessionStreamWriter::QueueBuffer,
+                                     this,
+                                     scoped_refptr<Session>(buffer->session),
+                                     base::Unretained(buffer)));
+
+  return true;
+}
+
+size_t SessionStreamWriter::block_size() const {
+  return kBlockSize;
+}
+
+bool SessionStreamWriter::Connect() {
+  DCHECK_EQ(INVALID_SOCKET, socket_);
+
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_protocol = IPPROTO_TCP;
+  addrinfo* addresses = NULL;
+  int result = ::getaddrinfo(host_.c_str(), port_.c_str(), &hints,
+                             &addresses);
+  if (result != 0) {
+    LOG(ERROR) << "Failed to resolve '" << host_ << ":" << port_ << "': "
+               << ::gai_strerrorA(result) << ".";
+    return false;
+  }
+
+  // Try each of the addresses in turn.
+  int error = 0;
+  for (addrinfo* address = addresses; address != NULL;
+       address = address->ai_next) {
+    SOCKET s = ::socket(address->ai_family, address->ai_socktype,
+                        address->ai_protocol);
+    if (s == INVALID_SOCKET) {
+      error = ::WSAGetLastError();
+      continue;
+    }
+    if (::connect(s, address->ai_addr, address->ai_addrlen) == 0) {
+      socket_ = s;
+      break;
+    }
+    error = ::WSAGetLastError();
+    ::closesocket(s);
+  }
+  ::freeaddrinfo(addresses);
+
+  if (socket_ == INVALID_SOCKET) {
+    LOG(ERROR) << "Failed to connect to '" << host_ << ":" << port_
+               << "': error " << error << ".";
+    return false;
+  }
+
+  // We batch our sends ourselves.
+  BOOL no_delay = TRUE;
+  ::setsockopt(socket_, IPPROTO_TCP, TCP_NODELAY,
+               reinterpret_cast<const char*>(&no_delay), sizeof(no_delay));
+
+  return true;
+}
+
+bool SessionStreamWriter::Send(WSABUF* buffers,
+                               size_t buffer_count,
+                               size_t length) {
+  DCHECK(buffers != NULL);
+  DCHECK_LT(0u, buffer_count);
+
+  if (socket_ == INVALID_SOCKET)
+    return false;
+
+  // Sends on a blocking socket only return once all of the data has been
+  // handed to the network stack, or the connection has failed.
+  DWORD bytes_sent = 0;
+  if (::WSASend(socket_, buffers, buffer_count, &bytes_sent, 0, NULL,
+                NULL) != 0 || bytes_sent != length) {
+    LOG(ERROR) << "Failed to send to '" << host_ << ":" << port_
+               << "': error " << ::WSAGetLastError() << ", buffers will be "
+               << "dropped.";
+    ::closesocket(socket_);
+    socket_ = INVALID_SOCKET;
+    return false;
+  }
+
+  bytes_sent_ += length;
+  return true;
+}
+
+void SessionStreamWriter::QueueBuffer(Session* session, Buffer* buffer) {
+  DCHECK(session != NULL);
+  DCHECK(buffer != NULL);
+  DCHECK_EQ(session, buffer->session);
+  DCHECK_EQ(Buffer::kPendingWrite, buffer->state);
+  DCHECK_EQ(base::MessageLoop::current(), message_loop_);
+
+  PendingBuffer* pending_buffer = new PendingBuffer(session, buffer);
+  if (!pending_buffer->mapped_buffer.Map()) {
+    delete pending_buffer;
+    return;
+  }
+
+  // We deliberately ignore invalid records, other than dropping them. This
+  // will log if anything goes wrong. Once the connection has failed, all
+  // buffers are dropped.
+  if (socket_ == INVALID_SOCKET ||
+      !layout_.GetRecordWriteSize(pending_buffer->mapped_buffer.data(),
+                                  buffer->buffer_size,
+                                  &pending_buffer->bytes_to_send) ||
+      pending_buffer->bytes_to_send == 0) {
+    RecyclePendingBuffer(pending_buffer);
+    return;
+  }
+
+  if (compress_segments_)
+    CompressPendingBuffer(pending_buffer);
+
+  // The buffers queued behind this one are sent along with it, as the send
+  // only runs once they have all been queued.
+  pending_buffers_.push_back(pending_buffer);
+  if (!send_posted_) {
+    send_posted_ = true;
+    message_loop_->PostTask(
+        FROM_HERE, base::Bind(&SessionStreamWriter::SendQueuedBuffers, this));
+  }
+}
+
+void SessionStreamWriter::SendQueuedBuffers() {
+  DCHECK_EQ(base::MessageLoop::current(), message_loop_);
+  DCHECK(send_posted_);
+
+  send_posted_ = false;
+  while (!pending_buffers_.empty()) {
+    std::vector<PendingBuffer*> batch;
+    std::vector<WSABUF> buffers;
+    size_t length = 0;
+    while (batch.size() < kMaxBuffersPerSend && !pending_buffers_.empty()) {
+      PendingBuffer* pending_buffer = pending_buffers_.front();
+      pending_buffers_.pop_front();
+      WSABUF wsa_buffer = {
+          pending_buffer->bytes_to_send,
+          reinterpret_cast<char*>(pending_buffer->data()) };
+      batch.push_back(pending_buffer);
+      buffers.push_back(wsa_buffer);
+      length += pending_buffer->bytes_to_send;
+    }
+
+    // This logs on failure, and the buffers are dropped either way.
+    Send(&buffers[0], buffers.size(), length);
+
+    for (size_t i = 0; i < batch.size(); ++i)
+      RecyclePendingBuffer(batch[i]);
+  }
+}
+
+void SessionStreamWriter::CompressPendingBuffer(
+    PendingBuffer* pending_buffer) {
+  DCHECK(pending_buffer != NULL);
+  DCHECK(pending_buffer->compressed_data.empty());
+  DCHECK_EQ(base::MessageLoop::current(), message_loop_);
+
+  // If compression fails or doesn't save a single block we simply send the
+  // segment as is.
+  std::vector<uint8> compressed_data(
+      layout_.GetCompressedRecordBound(pending_buffer->bytes_to_send));
+  size_t bytes_to_send = 0;
+  if (!layout_.CompressRecord(pending_buffer->mapped_buffer.data(),
+                              pending_buffer->bytes_to_send,
+                              &compressed_data[0],
+                              compressed_data.size(),
+                              &bytes_to_send) ||
+      bytes_to_send >= pending_buffer->bytes_to_send) {
+    return;
+  }
+
+  pending_buffer->compressed_data.swap(compressed_data);
+  pending_buffer->bytes_to_send = bytes_to_send;
+}
+
+void SessionStreamWriter::CloseConnection() {
+  DCHECK_EQ(base::MessageLoop::current(), message_loop_);
+  DCHECK(pending_buffers_.empty());
+
+  VLOG(1) << "Closing the stream to '" << host_ << ":" << port_
+          << "' after sending " << bytes_sent_ << " bytes.";
+
+  if (socket_ == INVALID_SOCKET)
+    return;
+
+  // Let the server see the end of the stream before we close the socket.
+  ::shutdown(socket_, SD_SEND);
+  ::closesocket(socket_);
+  socket_ = INVALID_SOCKET;
+}
+
+void SessionStreamWriter::RecyclePendingBuffer(PendingBuffer* pending_buffer) {
+  DCHECK(pending_buffer != NULL);
+
+  // As when writing trace files, we clear the RecordPrefix and the
+  // TraceFileSegmentHeader so that the buffer is seen as empty should it be
+  // handed back to us before the client touches it again.
+  ::memset(pending_buffer->mapped_buffer.data(), 0,
+           sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader));
+
+  pending_buffer->mapped_buffer.Unmap();
+
+  // Hang on to the session while we recycle the buffer, as deleting the
+  // pending buffer would otherwise release it.
+  scoped_refptr<Session> session(pending_buffer->session);
+  Buffer* buffer = pending_buffer->buffer;
+  delete pending_buffer;
+
+  session->RecycleBuffer(buffer);
+}
+
+}  // namespace service
+}  // namespace trace
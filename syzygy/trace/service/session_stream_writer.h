@@ -0,0 +1,162 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file declares the SessionStreamWriter class, a buffer consumer that
+// streams the buffers of a session to a remote aggregation server over TCP,
+// rather than writing them to a local trace file.
+//
+// The stream is laid out exactly as a trace file would be: the trace file
+// header, followed by each segment record padded to the block size. The
+// server may thus write it to disk as is, or parse it as it arrives, using
+// the same parser as for trace files. Segments may be compressed, as they may
+// be in trace files. The stream carries no index.
+
+#ifndef SYZYGY_TRACE_SERVICE_SESSION_STREAM_WRITER_H_
+#define SYZYGY_TRACE_SERVICE_SESSION_STREAM_WRITER_H_
+
+#include <winsock2.h>
+
+#include <deque>
+#include <string>
+
+#include "base/memory/ref_counted.h"
+#include "syzygy/trace/service/buffer_consumer.h"
+#include "syzygy/trace/service/trace_file_writer.h"
+
+// Forward declaration.
+namespace base { class MessageLoop; }
+
+namespace trace {
+namespace service {
+
+// This class implements the interface the buffer consumer thread uses to
+// stream incoming buffers to a remote server.
+//
+// Buffers are sent on the writer's message loop using blocking sends. Those
+// that arrive while a send is under way are queued, and the queue is then
+// sent as a single gather send of up to kMaxBuffersPerSend buffers. Each
+// buffer is only recycled once it has been sent, so a slow network or server
+// applies back-pressure to the session exactly as a slow disk does.
+//
+// Should the connection fail, subsequent buffers are recycled without being
+// sent, and the session carries on.
+class SessionStreamWriter : public BufferConsumer {
+ public:
+  // The block size to which records are aligned in the stream. This only
+  // needs to match the alignment a trace file would have on the server.
+  static const size_t kBlockSize = 512;
+
+  // The maximum number of buffers coalesced into a single send.
+  static const size_t kMaxBuffersPerSend = 16;
+
+  // Construct a SessionStreamWriter instance.
+  // @param message_loop The message loop on which this writer instance will
+  //     send buffers. The writer instance does NOT take ownership of the
+  //     message_loop. The message_loop must outlive the writer instance.
+  // @param host The name or address of the aggregation server.
+  // @param port The port on which the aggregation server listens.
+  SessionStreamWriter(base::MessageLoop* message_loop,
+                      const std::string& host,
+                      const std::string& port);
+
+  // @name BufferConsumer implementation.
+  // @{
+  virtual bool Open(Session* session) OVERRIDE;
+  virtual bool Close(Session* session) OVERRIDE;
+  virtual bool ConsumeBuffer(Buffer* buffer) OVERRIDE;
+  virtual size_t block_size() const OVERRIDE;
+  // @}
+
+  // Sets whether this writer compresses the segments it sends. This must be
+  // set before the writer consumes any buffers.
+  void set_compress_segments(bool compress_segments) {
+    compress_segments_ = compress_segments;
+  }
+
+  // @returns the number of bytes sent to the server. This is only accessed
+  //     on the message loop once the writer has been opened.
+  uint64 bytes_sent() const { return bytes_sent_; }
+
+ protected:
+  virtual ~SessionStreamWriter();
+
+  // A buffer waiting to be sent.
+  struct PendingBuffer;
+
+  // Connects to the server. This is called on the thread opening the writer.
+  // @returns true on success, false otherwise.
+  bool Connect();
+
+  // Sends data to the server, blocking until it has all been sent. The
+  // connection is closed on failure.
+  // @param buffers The buffers holding the data, in stream order.
+  // @param buffer_count The number of @p buffers.
+  // @param length The total length of @p buffers.
+  // @returns true on success, false otherwise.
+  bool Send(WSABUF* buffers, size_t buffer_count, size_t length);
+
+  // Queues a buffer for sending. This will be called on message_loop_.
+  void QueueBuffer(Session* session, Buffer* buffer);
+
+  // Sends the queued buffers, then recycles them. This will be called on
+  // message_loop_.
+  void SendQueuedBuffers();
+
+  // Compresses the segment of @p pending_buffer, provided that saves space.
+  // This will be called on message_loop_.
+  void CompressPendingBuffer(PendingBuffer* pending_buffer);
+
+  // Closes the connection to the server. This will be called on
+  // message_loop_.
+  void CloseConnection();
+
+  // Clears, unmaps and recycles a buffer, then deletes it.
+  void RecyclePendingBuffer(PendingBuffer* pending_buffer);
+
+  // The message loop on which buffers are sent.
+  base::MessageLoop* const message_loop_;
+
+  // The server to which buffers are sent.
+  std::string host_;
+  std::string port_;
+
+  // The connection to the server. This is INVALID_SOCKET once the connection
+  // has failed or been closed.
+  SOCKET socket_;
+
+  // Validates and compresses records, laid out as in a trace file. This never
+  // opens a trace file.
+  TraceFileWriter layout_;
+
+  // Whether this writer compresses the segments it sends.
+  bool compress_segments_;
+
+  // The buffers waiting to be sent. This is only accessed on message_loop_.
+  std::deque<PendingBuffer*> pending_buffers_;
+
+  // True if SendQueuedBuffers has been posted and hasn't yet run. This is
+  // only accessed on message_loop_.
+  bool send_posted_;
+
+  // The number of bytes sent to the server.
+  uint64 bytes_sent_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(SessionStreamWriter);
+};
+
+}  // namespace service
+}  // namespace trace
+
+#endif  // SYZYGY_TRACE_SERVICE_SESSION_STREAM_WRITER_H_
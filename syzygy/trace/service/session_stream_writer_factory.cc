@@ -0,0 +1,71 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/service/session_stream_writer_factory.h"
+
+#include <winsock2.h>
+
+#include "base/logging.h"
+#include "syzygy/trace/service/session_stream_writer.h"
+
+namespace trace {
+namespace service {
+
+SessionStreamWriterFactory::SessionStreamWriterFactory(
+    base::MessageLoop* message_loop,
+    const std::string& host,
+    const std::string& port)
+    : message_loop_(message_loop),
+      host_(host),
+      port_(port),
+      compress_segments_(false),
+      winsock_initialized_(false) {
+  DCHECK(message_loop != NULL);
+  DCHECK(!host.empty());
+  DCHECK(!port.empty());
+}
+
+SessionStreamWriterFactory::~SessionStreamWriterFactory() {
+  if (winsock_initialized_)
+    ::WSACleanup();
+}
+
+bool SessionStreamWriterFactory::Init() {
+  DCHECK(!winsock_initialized_);
+
+  WSADATA wsa_data = {};
+  int result = ::WSAStartup(MAKEWORD(2, 2), &wsa_data);
+  if (result != 0) {
+    LOG(ERROR) << "Failed to initialize Winsock: error " << result << ".";
+    return false;
+  }
+
+  winsock_initialized_ = true;
+  return true;
+}
+
+bool SessionStreamWriterFactory::CreateConsumer(
+    scoped_refptr<BufferConsumer>* consumer) {
+  DCHECK(consumer != NULL);
+  DCHECK(winsock_initialized_);
+
+  SessionStreamWriter* writer = new SessionStreamWriter(message_loop_, host_,
+                                                        port_);
+  writer->set_compress_segments(compress_segments_);
+  *consumer = writer;
+  return true;
+}
+
+}  // namespace service
+}  // namespace trace
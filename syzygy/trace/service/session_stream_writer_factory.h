@@ -0,0 +1,89 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file declares the factory for SessionStreamWriter objects. This is
+// used by the service to create buffer consumers that stream the buffers of
+// individual sessions to a remote aggregation server.
+
+#ifndef SYZYGY_TRACE_SERVICE_SESSION_STREAM_WRITER_FACTORY_H_
+#define SYZYGY_TRACE_SERVICE_SESSION_STREAM_WRITER_FACTORY_H_
+
+#include <string>
+
+#include "syzygy/trace/service/buffer_consumer.h"
+
+// Forward declaration.
+namespace base { class MessageLoop; }
+
+namespace trace {
+namespace service {
+
+// This class creates stream writers for a call trace service instance. Each
+// session gets its own connection to the server.
+class SessionStreamWriterFactory : public BufferConsumerFactory {
+ public:
+  // Construct a SessionStreamWriterFactory instance.
+  // @param message_loop The message loop on which SessionStreamWriter
+  //     instances created by this factory will send buffers. The factory
+  //     instance does NOT take ownership of the message_loop. The
+  //     message_loop must outlive the factory instance.
+  // @param host The name or address of the aggregation server.
+  // @param port The port on which the aggregation server listens.
+  SessionStreamWriterFactory(base::MessageLoop* message_loop,
+                             const std::string& host,
+                             const std::string& port);
+
+  ~SessionStreamWriterFactory();
+
+  // Initializes Winsock, which the stream writers use. This must be called
+  // before any consumers are created.
+  // @returns true on success, false otherwise.
+  bool Init();
+
+  // @name BufferConsumerFactory implementation.
+  // @{
+  virtual bool CreateConsumer(scoped_refptr<BufferConsumer>* consumer) OVERRIDE;
+  // @}
+
+  // Sets whether subsequently created stream writers compress the segments
+  // they send. This is off by default.
+  void set_compress_segments(bool compress_segments) {
+    compress_segments_ = compress_segments;
+  }
+
+  // @returns true iff stream writers compress the segments they send.
+  bool compress_segments() const { return compress_segments_; }
+
+ protected:
+  // The message loop the stream writers use to send buffers.
+  base::MessageLoop* const message_loop_;
+
+  // The server to which the stream writers connect.
+  std::string host_;
+  std::string port_;
+
+  // Whether stream writers compress the segments they send.
+  bool compress_segments_;
+
+  // True once Winsock has been initialized.
+  bool winsock_initialized_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(SessionStreamWriterFactory);
+};
+
+}  // namespace service
+}  // namespace trace
+
+#endif  // SYZYGY_TRACE_SERVICE_SESSION_STREAM_WRITER_FACTORY_H_
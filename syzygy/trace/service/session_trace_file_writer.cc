@@ -19,8 +19,15 @@
 
 #include "syzygy/trace/service/session_trace_file_writer.h"
 
+#include <algorithm>
+
 #include "base/bind.h"
 #include "base/file_util.h"
+#include "base/stl_util.h"
+#include "base/stringprintf.h"
+#include "sawbuck/common/com_utils.h"
+#include "syzygy/common/align.h"
+#include "syzygy/trace/common/clock.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 #include "syzygy/trace/service/buffer_pool.h"
 #include "syzygy/trace/service/mapped_buffer.h"
@@ -29,12 +36,177 @@
 namespace trace {
 namespace service {
 
+namespace {
+
+size_t GetPageSize() {
+  SYSTEM_INFO system_info = {};
+  ::GetSystemInfo(&system_info);
+  return system_info.dwPageSize;
+}
+
+}  // namespace
+
+WriteQueueCounters::WriteQueueCounters()
+    : queue_depth_(0),
+      max_queue_depth_(0),
+      bytes_queued_(0),
+      bytes_consumed_(0) {
+}
+
+WriteQueueCounters::~WriteQueueCounters() {
+}
+
+void WriteQueueCounters::AddBuffer(size_t buffer_size) {
+  base::AutoLock auto_lock(lock_);
+  ++queue_depth_;
+  max_queue_depth_ = std::max(max_queue_depth_, queue_depth_);
+  bytes_queued_ += buffer_size;
+  bytes_consumed_ += buffer_size;
+}
+
+void WriteQueueCounters::RemoveBuffer(size_t buffer_size) {
+  base::AutoLock auto_lock(lock_);
+  DCHECK_LT(0u, queue_depth_);
+  DCHECK_LE(buffer_size, bytes_queued_);
+  --queue_depth_;
+  bytes_queued_ -= buffer_size;
+}
+
+void WriteQueueCounters::RemoveBytesConsumed(uint64 bytes_consumed) {
+  base::AutoLock auto_lock(lock_);
+  DCHECK_LE(bytes_consumed, bytes_consumed_);
+  bytes_consumed_ -= bytes_consumed;
+}
+
+size_t WriteQueueCounters::queue_depth() const {
+  base::AutoLock auto_lock(lock_);
+  return queue_depth_;
+}
+
+size_t WriteQueueCounters::max_queue_depth() const {
+  base::AutoLock auto_lock(lock_);
+  return max_queue_depth_;
+}
+
+size_t WriteQueueCounters::bytes_queued() const {
+  base::AutoLock auto_lock(lock_);
+  return bytes_queued_;
+}
+
+uint64 WriteQueueCounters::bytes_consumed() const {
+  base::AutoLock auto_lock(lock_);
+  return bytes_consumed_;
+}
+
+struct SessionTraceFileWriter::PendingBuffer {
+  PendingBuffer(Session* session, Buffer* buffer)
+      : session(session), buffer(buffer), mapped_buffer(buffer),
+        compressed_data(NULL), bytes_to_write(0) {
+    ::memset(&index_entry, 0, sizeof(index_entry));
+  }
+
+  ~PendingBuffer() {
+    if (compressed_data != NULL)
+      ::VirtualFree(compressed_data, 0, MEM_RELEASE);
+  }
+
+  // @returns the data to commit to disk.
+  uint8* data() const {
+    return compressed_data != NULL ? compressed_data : mapped_buffer.data();
+  }
+
+  // Keeps the session alive until the buffer has been recycled.
+  scoped_refptr<Session> session;
+  Buffer* buffer;
+  MappedBuffer mapped_buffer;
+  // The compressed segment, if the buffer was compressed. This is allocated
+  // with VirtualAlloc, so as to satisfy the alignment requirements of
+  // unbuffered writes.
+  uint8* compressed_data;
+  // The number of bytes of data() to commit to disk.
+  size_t bytes_to_write;
+  // Describes the segment in the trace file index, if it's being written. This
+  // is captured before the segment is compressed.
+  TraceFileIndexEntry index_entry;
+};
+
+struct SessionTraceFileWriter::WriteRequest {
+  WriteRequest() : chunk(NULL), bytes_to_write(0) {
+    ::memset(&context, 0, sizeof(context));
+  }
+
+  // This must be the first member, as the completion is handed back to us as
+  // a pointer to it.
+  base::MessageLoopForIO::IOContext context;
+  // The chunk being written to.
+  Chunk* chunk;
+  // The buffers being written, in file order.
+  std::vector<PendingBuffer*> buffers;
+  // The page-sized segments of a gather write. This is empty if there is a
+  // single buffer being written with a plain WriteFile.
+  std::vector<FILE_SEGMENT_ELEMENT> segments;
+  // The total number of bytes being written.
+  size_t bytes_to_write;
+};
+
+struct SessionTraceFileWriter::Chunk {
+  Chunk() : record_bytes(0), writes_in_flight(0) {
+  }
+
+  TraceFileWriter writer;
+  // The time at which the chunk was opened.
+  base::TimeTicks open_time;
+  // The number of bytes of segments written, or being written, to the chunk.
+  // This counts neither the header nor the replayed module events.
+  uint64 record_bytes;
+  // The number of writes currently in flight to the chunk.
+  size_t writes_in_flight;
+};
+
 SessionTraceFileWriter::SessionTraceFileWriter(
     MessageLoop* message_loop, const base::FilePath& trace_directory)
     : message_loop_(message_loop),
-      trace_file_path_(trace_directory) {
+      trace_file_path_(trace_directory),
+      page_size_(GetPageSize()),
+      block_size_(0),
+      compress_segments_(false),
+      write_index_(false),
+      max_chunk_size_(0),
+      writes_in_flight_(0),
+      num_chunks_(0),
+      counters_(new WriteQueueCounters()) {
+  DCHECK(message_loop != NULL);
+  DCHECK(!trace_directory.empty());
+}
+
+SessionTraceFileWriter::SessionTraceFileWriter(
+    MessageLoop* message_loop,
+    const base::FilePath& trace_directory,
+    WriteQueueCounters* message_loop_counters)
+    : message_loop_(message_loop),
+      trace_file_path_(trace_directory),
+      page_size_(GetPageSize()),
+      block_size_(0),
+      compress_segments_(false),
+      write_index_(false),
+      max_chunk_size_(0),
+      writes_in_flight_(0),
+      num_chunks_(0),
+      counters_(new WriteQueueCounters()),
+      message_loop_counters_(message_loop_counters) {
   DCHECK(message_loop != NULL);
   DCHECK(!trace_directory.empty());
+  DCHECK(message_loop_counters != NULL);
+}
+
+SessionTraceFileWriter::~SessionTraceFileWriter() {
+  DCHECK(pending_buffers_.empty());
+  DCHECK_EQ(0u, writes_in_flight_);
+  DCHECK(retired_chunks_.empty());
+  STLDeleteElements(&retired_chunks_);
+
+  if (message_loop_counters_.get() != NULL)
+    message_loop_counters_->RemoveBytesConsumed(counters_->bytes_consumed());
 }
 
 bool SessionTraceFileWriter::Open(Session* session) {
@@ -52,16 +224,30 @@ bool SessionTraceFileWriter::Open(Session* session) {
       session->client_info());
   trace_file_path_ = trace_file_path_.Append(basename);
 
-  // Open the trace file and write the header.
-  if (!writer_.Open(trace_file_path_) ||
-      !writer_.WriteHeader(session->client_info())) {
+  // Open the trace file, or its first chunk, and write the header.
+  chunk_.reset(OpenChunk(session->client_info()));
+  if (chunk_.get() == NULL)
     return false;
-  }
+  block_size_ = chunk_->writer.block_size();
 
   return true;
 }
 
 bool SessionTraceFileWriter::Close(Session* /* session */) {
+  // Buffers are only recycled once their writes have completed, so by the time
+  // the session closes us there is nothing left in flight.
+  VLOG(1) << "Closing '" << trace_file_path_.value() << "' after consuming "
+          << counters_->bytes_consumed() << " bytes, with at most "
+          << counters_->max_queue_depth() << " buffers queued at once.";
+
+  // The index is appended on the message loop, which is where the record
+  // space of the trace file is reserved. The chunk callback is run from there
+  // too.
+  if (write_index_ || !chunk_callback_.is_null()) {
+    message_loop_->PostTask(
+        FROM_HERE, base::Bind(&SessionTraceFileWriter::CloseTraceFile, this));
+  }
+
   return true;
 }
 
@@ -70,6 +256,10 @@ bool SessionTraceFileWriter::ConsumeBuffer(Buffer* buffer) {
   DCHECK(buffer->session != NULL);
   DCHECK(message_loop_ != NULL);
 
+  counters_->AddBuffer(buffer->buffer_size);
+  if (message_loop_counters_.get() != NULL)
+    message_loop_counters_->AddBuffer(buffer->buffer_size);
+
   message_loop_->PostTask(FROM_HERE,
                           base::Bind(&SessionTraceFileWriter::WriteBuffer,
                                      this,
@@ -80,7 +270,41 @@ bool SessionTraceFileWriter::ConsumeBuffer(Buffer* buffer) {
 }
 
 size_t SessionTraceFileWriter::block_size() const {
-  return writer_.block_size();
+  return block_size_;
+}
+
+void SessionTraceFileWriter::OnIOCompleted(
+    base::MessageLoopForIO::IOContext* context,
+    DWORD bytes_transferred,
+    DWORD error) {
+  DCHECK(context != NULL);
+  DCHECK_EQ(MessageLoop::current(), message_loop_);
+  DCHECK_LT(0u, writes_in_flight_);
+
+  WriteRequest* request = reinterpret_cast<WriteRequest*>(context);
+  DCHECK_EQ(static_cast<base::MessageLoopForIO::IOHandler*>(this),
+            request->context.handler);
+  Chunk* chunk = request->chunk;
+  DCHECK(chunk != NULL);
+  DCHECK_LT(0u, chunk->writes_in_flight);
+
+  if (error != ERROR_SUCCESS || bytes_transferred != request->bytes_to_write) {
+    LOG(ERROR) << "Failed writing to '" << chunk->writer.path().value()
+               << "': " << com::LogWe(error) << ".";
+  }
+
+  --writes_in_flight_;
+  --chunk->writes_in_flight;
+  CompleteWriteRequest(request);
+
+  // A rotated out chunk is done with once its last write has completed.
+  if (chunk != chunk_.get() && chunk->writes_in_flight == 0) {
+    DCHECK_EQ(1u, retired_chunks_.count(chunk));
+    retired_chunks_.erase(chunk);
+    FinishChunk(chunk);
+  }
+
+  IssueWrites();
 }
 
 void SessionTraceFileWriter::WriteBuffer(Session* session, Buffer* buffer) {
@@ -90,23 +314,406 @@ void SessionTraceFileWriter::WriteBuffer(Session* session, Buffer* buffer) {
   DCHECK_EQ(Buffer::kPendingWrite, buffer->state);
   DCHECK_EQ(MessageLoop::current(), message_loop_);
 
-  MappedBuffer mapped_buffer(buffer);
-  if (!mapped_buffer.Map())
+  PendingBuffer* pending_buffer = new PendingBuffer(session, buffer);
+  if (!pending_buffer->mapped_buffer.Map()) {
+    delete pending_buffer;
+    counters_->RemoveBuffer(buffer->buffer_size);
+    if (message_loop_counters_.get() != NULL)
+      message_loop_counters_->RemoveBuffer(buffer->buffer_size);
+    return;
+  }
+
+  // We deliberately ignore invalid records, other than dropping them. This
+  // will log if anything goes wrong.
+  TraceFileWriter& writer = chunk_->writer;
+  if (!writer.GetRecordWriteSize(pending_buffer->mapped_buffer.data(),
+                                 buffer->buffer_size,
+                                 &pending_buffer->bytes_to_write) ||
+      pending_buffer->bytes_to_write == 0) {
+    RecyclePendingBuffer(pending_buffer);
     return;
+  }
+
+  if (write_index_) {
+    writer.GetRecordIndexEntry(pending_buffer->mapped_buffer.data(),
+                               buffer->buffer_size,
+                               &pending_buffer->index_entry);
+  }
+
+  // The module events have to be seen before the segment is compressed.
+  if (rotates()) {
+    TrackLoadedModules(pending_buffer->mapped_buffer.data(),
+                       buffer->buffer_size);
+  }
+
+  if (compress_segments_)
+    CompressPendingBuffer(pending_buffer);
+
+  pending_buffers_.push_back(pending_buffer);
+  IssueWrites();
+}
+
+void SessionTraceFileWriter::IssueWrites() {
+  DCHECK_EQ(MessageLoop::current(), message_loop_);
+
+  while (writes_in_flight_ < kMaxWritesInFlight && !pending_buffers_.empty()) {
+    // Move on to a new chunk once the current one is full or has grown old,
+    // as long as it holds something. If that fails we carry on with the
+    // current chunk, and stop rotating.
+    PendingBuffer* next_buffer = pending_buffers_.front();
+    if (rotates() && chunk_->record_bytes != 0 &&
+        (ChunkWouldOverflow(next_buffer->bytes_to_write) ||
+         (max_chunk_duration_ > base::TimeDelta() &&
+          base::TimeTicks::Now() - chunk_->open_time >=
+              max_chunk_duration_))) {
+      if (!RotateChunk(next_buffer->session->client_info())) {
+        LOG(ERROR) << "Failed to rotate '" << trace_file_path_.value()
+                   << "', it will keep growing.";
+        max_chunk_size_ = 0;
+        max_chunk_duration_ = base::TimeDelta();
+      }
+    }
+
+    // Grab the longest run of queued buffers that can be written at once,
+    // without overflowing the chunk.
+    WriteRequest* request = new WriteRequest();
+    request->context.handler = this;
+    request->chunk = chunk_.get();
+    do {
+      PendingBuffer* pending_buffer = pending_buffers_.front();
+      if (!request->buffers.empty() &&
+          (!CanCoalesce(request->buffers.back(), pending_buffer) ||
+           ChunkWouldOverflow(request->bytes_to_write +
+                              pending_buffer->bytes_to_write))) {
+        break;
+      }
+      pending_buffers_.pop_front();
+      request->buffers.push_back(pending_buffer);
+      request->bytes_to_write += pending_buffer->bytes_to_write;
+    } while (request->buffers.size() < kMaxBuffersPerWrite &&
+             !pending_buffers_.empty());
+
+    TraceFileWriter& writer = chunk_->writer;
+    chunk_->record_bytes += request->bytes_to_write;
+    uint64 offset = writer.ReserveRecordSpace(request->bytes_to_write);
+    request->context.overlapped.Offset = static_cast<DWORD>(offset);
+    request->context.overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
 
-  // We deliberately ignore the return status. However, this will log if
-  // anything goes wrong.
-  writer_.WriteRecord(mapped_buffer.data(), buffer->buffer_size);
+    BOOL success = FALSE;
+    if (request->buffers.size() == 1) {
+      success = ::WriteFile(writer.handle(),
+                            request->buffers[0]->data(),
+                            request->bytes_to_write,
+                            NULL,
+                            &request->context.overlapped);
+    } else {
+      // A gather write takes one segment per page, terminated by a NULL
+      // segment. Only the last buffer may end on a partial page.
+      for (size_t i = 0; i < request->buffers.size(); ++i) {
+        const PendingBuffer* pending_buffer = request->buffers[i];
+        uint8* data = pending_buffer->data();
+        for (size_t j = 0; j < pending_buffer->bytes_to_write;
+             j += page_size_) {
+          FILE_SEGMENT_ELEMENT segment = {};
+          segment.Buffer = PtrToPtr64(data + j);
+          request->segments.push_back(segment);
+        }
+      }
+      FILE_SEGMENT_ELEMENT terminator = {};
+      request->segments.push_back(terminator);
+
+      success = ::WriteFileGather(writer.handle(),
+                                  &request->segments[0],
+                                  request->bytes_to_write,
+                                  NULL,
+                                  &request->context.overlapped);
+    }
+
+    // Even a write that completes immediately posts its completion to the
+    // message loop, so we're done with the request until then.
+    DWORD error = ::GetLastError();
+    if (success || error == ERROR_IO_PENDING) {
+      for (size_t i = 0; i < request->buffers.size(); ++i) {
+        writer.AddIndexEntry(offset, request->buffers[i]->index_entry);
+        offset += request->buffers[i]->bytes_to_write;
+      }
+      ++writes_in_flight_;
+      ++chunk_->writes_in_flight;
+      continue;
+    }
+
+    // The space reserved for these buffers is left as a hole in the trace
+    // file; by now the file space for later writes may have been reserved.
+    LOG(ERROR) << "Failed writing to '" << writer.path().value()
+               << "': " << com::LogWe(error) << ".";
+    CompleteWriteRequest(request);
+  }
+}
+
+bool SessionTraceFileWriter::CanCoalesce(const PendingBuffer* last,
+                                         const PendingBuffer* next) const {
+  DCHECK(last != NULL);
+  DCHECK(next != NULL);
+
+  // Each segment of a gather write must be a whole, page-aligned page, except
+  // that the write as a whole may end part way through the last page.
+  const uintptr_t kPageMask = page_size_ - 1;
+  uintptr_t last_data = reinterpret_cast<uintptr_t>(last->data());
+  uintptr_t next_data = reinterpret_cast<uintptr_t>(next->data());
+  return last->compressed_data == NULL && next->compressed_data == NULL &&
+      (last_data & kPageMask) == 0 &&
+      (last->bytes_to_write & kPageMask) == 0 &&
+      (next_data & kPageMask) == 0;
+}
+
+void SessionTraceFileWriter::CompressPendingBuffer(
+    PendingBuffer* pending_buffer) {
+  DCHECK(pending_buffer != NULL);
+  DCHECK(pending_buffer->compressed_data == NULL);
+  DCHECK_EQ(MessageLoop::current(), message_loop_);
+
+  const TraceFileWriter& writer = chunk_->writer;
+  size_t bound = writer.GetCompressedRecordBound(
+      pending_buffer->bytes_to_write);
+  uint8* compressed_data = reinterpret_cast<uint8*>(
+      ::VirtualAlloc(NULL, bound, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+  if (compressed_data == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to allocate compression buffer: "
+               << com::LogWe(error) << ".";
+    return;
+  }
+
+  // If compression fails or doesn't save a single block we simply write the
+  // segment as is.
+  size_t bytes_to_write = 0;
+  if (!writer.CompressRecord(pending_buffer->mapped_buffer.data(),
+                             pending_buffer->bytes_to_write,
+                             compressed_data,
+                             bound,
+                             &bytes_to_write) ||
+      bytes_to_write >= pending_buffer->bytes_to_write) {
+    ::VirtualFree(compressed_data, 0, MEM_RELEASE);
+    return;
+  }
+
+  pending_buffer->compressed_data = compressed_data;
+  pending_buffer->bytes_to_write = bytes_to_write;
+}
+
+void SessionTraceFileWriter::CloseTraceFile() {
+  DCHECK_EQ(MessageLoop::current(), message_loop_);
+  DCHECK(pending_buffers_.empty());
+  DCHECK_EQ(0u, writes_in_flight_);
+  DCHECK(retired_chunks_.empty());
+
+  if (chunk_.get() != NULL)
+    FinishChunk(chunk_.release());
+}
+
+SessionTraceFileWriter::Chunk* SessionTraceFileWriter::OpenChunk(
+    const ProcessInfo& process_info) {
+  // The chunks of a rotated trace file are all numbered, so that they sort in
+  // order.
+  base::FilePath path(trace_file_path_);
+  if (rotates()) {
+    path = path.InsertBeforeExtension(
+        base::StringPrintf(L"-chunk-%04d", num_chunks_));
+  }
+
+  scoped_ptr<Chunk> chunk(new Chunk());
+  chunk->writer.set_write_index(write_index_);
+  if (!chunk->writer.Open(path, TraceFileWriter::kOverlappedIo) ||
+      !chunk->writer.WriteHeader(process_info) ||
+      !WriteLoadedModules(&chunk->writer)) {
+    return NULL;
+  }
+  chunk->open_time = base::TimeTicks::Now();
+  ++num_chunks_;
+
+  // Route the completions of our writes to the IO message loop.
+  DCHECK_EQ(base::MessageLoop::TYPE_IO, message_loop_->type());
+  static_cast<base::MessageLoopForIO*>(message_loop_)->RegisterIOHandler(
+      chunk->writer.handle(), this);
+
+  return chunk.release();
+}
+
+bool SessionTraceFileWriter::RotateChunk(const ProcessInfo& process_info) {
+  DCHECK_EQ(MessageLoop::current(), message_loop_);
+  DCHECK(chunk_.get() != NULL);
+
+  Chunk* chunk = OpenChunk(process_info);
+  if (chunk == NULL)
+    return false;
+
+  // The chunk being rotated out is finished as soon as nothing is left in
+  // flight to it.
+  Chunk* old_chunk = chunk_.release();
+  chunk_.reset(chunk);
+  if (old_chunk->writes_in_flight == 0) {
+    FinishChunk(old_chunk);
+  } else {
+    retired_chunks_.insert(old_chunk);
+  }
+
+  return true;
+}
+
+void SessionTraceFileWriter::FinishChunk(Chunk* chunk) {
+  DCHECK_EQ(MessageLoop::current(), message_loop_);
+  DCHECK(chunk != NULL);
+  DCHECK_EQ(0u, chunk->writes_in_flight);
+
+  scoped_ptr<Chunk> scoped_chunk(chunk);
+  base::FilePath path(chunk->writer.path());
+  if (!chunk->writer.Close()) {
+    LOG(ERROR) << "Failed to close '" << path.value() << "'.";
+    return;
+  }
+
+  if (!chunk_callback_.is_null())
+    chunk_callback_.Run(path);
+}
+
+bool SessionTraceFileWriter::ChunkWouldOverflow(size_t bytes_to_write) const {
+  DCHECK(chunk_.get() != NULL);
+  return max_chunk_size_ != 0 &&
+      chunk_->record_bytes + bytes_to_write > max_chunk_size_;
+}
+
+void SessionTraceFileWriter::TrackLoadedModules(const uint8* data,
+                                                size_t length) {
+  DCHECK(data != NULL);
+
+  const size_t kHeaderLength =
+      sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
+  DCHECK_LE(kHeaderLength, length);
+  const TraceFileSegmentHeader* header =
+      reinterpret_cast<const TraceFileSegmentHeader*>(
+          data + sizeof(RecordPrefix));
+
+  // As in TraceFileWriter::GetRecordIndexEntry, the segment length is read
+  // only once and the walk is kept within the buffer.
+  size_t segment_length = std::min(static_cast<size_t>(header->segment_length),
+                                   length - kHeaderLength);
+  const uint8* next = data + kHeaderLength;
+  const uint8* end = next + segment_length;
+  while (static_cast<size_t>(end - next) >= sizeof(RecordPrefix)) {
+    const RecordPrefix* prefix = reinterpret_cast<const RecordPrefix*>(next);
+    size_t remaining = end - next - sizeof(RecordPrefix);
+    if (prefix->size > remaining)
+      break;
+    next += sizeof(RecordPrefix) + prefix->size;
+
+    if ((prefix->type != TRACE_PROCESS_ATTACH_EVENT &&
+         prefix->type != TRACE_PROCESS_DETACH_EVENT) ||
+        prefix->size < sizeof(TraceModuleData)) {
+      continue;
+    }
+
+    // Incompletely written events are skipped, as the parser does.
+    const TraceModuleData* module_data =
+        reinterpret_cast<const TraceModuleData*>(prefix + 1);
+    if (module_data->module_base_addr == NULL)
+      continue;
+
+    if (prefix->type == TRACE_PROCESS_DETACH_EVENT) {
+      loaded_modules_.erase(module_data->module_base_addr);
+      continue;
+    }
+
+    LoadedModule& loaded_module =
+        loaded_modules_[module_data->module_base_addr];
+    loaded_module.timestamp = prefix->timestamp;
+    loaded_module.module_data = *module_data;
+  }
+}
+
+bool SessionTraceFileWriter::WriteLoadedModules(TraceFileWriter* writer) {
+  DCHECK(writer != NULL);
+
+  if (loaded_modules_.empty())
+    return true;
+
+  // The events go in a single segment, which like the other segments written
+  // by the service is attributed to no thread in particular.
+  const size_t kEventSize = sizeof(RecordPrefix) + sizeof(TraceModuleData);
+  const size_t kHeaderLength =
+      sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
+  size_t segment_length = loaded_modules_.size() * kEventSize;
+  std::vector<uint8> buffer(
+      ::common::AlignUp(kHeaderLength + segment_length, writer->block_size()));
+
+  RecordPrefix* segment_prefix = reinterpret_cast<RecordPrefix*>(&buffer[0]);
+  segment_prefix->timestamp = trace::common::GetTsc();
+  segment_prefix->size = sizeof(TraceFileSegmentHeader);
+  segment_prefix->type = TraceFileSegmentHeader::kTypeId;
+  segment_prefix->version.hi = TRACE_VERSION_HI;
+  segment_prefix->version.lo = TRACE_VERSION_LO;
+
+  TraceFileSegmentHeader* segment_header =
+      reinterpret_cast<TraceFileSegmentHeader*>(segment_prefix + 1);
+  segment_header->thread_id = 0;
+  segment_header->segment_length = segment_length;
+
+  // The events keep their original timestamps.
+  uint8* next = reinterpret_cast<uint8*>(segment_header + 1);
+  LoadedModuleMap::const_iterator it = loaded_modules_.begin();
+  for (; it != loaded_modules_.end(); ++it) {
+    RecordPrefix* event_prefix = reinterpret_cast<RecordPrefix*>(next);
+    event_prefix->timestamp = it->second.timestamp;
+    event_prefix->size = sizeof(TraceModuleData);
+    event_prefix->type = TRACE_PROCESS_ATTACH_EVENT;
+    event_prefix->version.hi = TRACE_VERSION_HI;
+    event_prefix->version.lo = TRACE_VERSION_LO;
+    ::memcpy(event_prefix + 1, &it->second.module_data,
+             sizeof(TraceModuleData));
+    next += kEventSize;
+  }
+
+  if (!writer->WriteRecord(&buffer[0], buffer.size())) {
+    LOG(ERROR) << "Failed to write the loaded modules to '"
+               << writer->path().value() << "'.";
+    return false;
+  }
+
+  return true;
+}
+
+void SessionTraceFileWriter::CompleteWriteRequest(WriteRequest* request) {
+  DCHECK(request != NULL);
+
+  for (size_t i = 0; i < request->buffers.size(); ++i)
+    RecyclePendingBuffer(request->buffers[i]);
+  delete request;
+}
+
+void SessionTraceFileWriter::RecyclePendingBuffer(
+    PendingBuffer* pending_buffer) {
+  DCHECK(pending_buffer != NULL);
 
   // It's entirely possible for this buffer to be handed out to another client
   // and for the service to be forcibly shutdown before the client has had a
   // chance to even touch the buffer. In that case, we'll end up writing the
   // buffer again. We clear the RecordPrefix and the TraceFileSegmentHeader so
   // that we'll at least see the buffer as empty and write nothing.
-  ::memset(mapped_buffer.data(), 0,
+  ::memset(pending_buffer->mapped_buffer.data(), 0,
            sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader));
 
-  mapped_buffer.Unmap();
+  pending_buffer->mapped_buffer.Unmap();
+
+  // Hang on to the session while we recycle the buffer, as deleting the
+  // pending buffer would otherwise release it.
+  scoped_refptr<Session> session(pending_buffer->session);
+  Buffer* buffer = pending_buffer->buffer;
+  delete pending_buffer;
+
+  // The buffer leaves the queue before it's handed back, as the session may
+  // be closed as soon as its last buffer is recycled.
+  counters_->RemoveBuffer(buffer->buffer_size);
+  if (message_loop_counters_.get() != NULL)
+    message_loop_counters_->RemoveBuffer(buffer->buffer_size);
   session->RecycleBuffer(buffer);
 }
 
@@ -19,7 +19,18 @@
 #ifndef SYZYGY_TRACE_SERVICE_SESSION_TRACE_FILE_WRITER_H_
 #define SYZYGY_TRACE_SERVICE_SESSION_TRACE_FILE_WRITER_H_
 
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "base/callback.h"
+#include "base/message_loop.h"
+#include "base/time.h"
 #include "base/files/file_path.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/synchronization/lock.h"
 #include "base/threading/thread.h"
 #include "base/win/scoped_handle.h"
 #include "syzygy/trace/service/buffer_consumer.h"
@@ -32,19 +43,114 @@ namespace service {
 class Session;
 class SessionTraceFileWriterFactory;
 
+// Counts the buffers queued for writing by one or more trace file writers. A
+// buffer is counted from the moment it is handed to a writer until it has been
+// written and recycled. This is thread-safe.
+class WriteQueueCounters
+    : public base::RefCountedThreadSafe<WriteQueueCounters> {
+ public:
+  WriteQueueCounters();
+
+  // Accounts for a buffer entering or leaving the write queue.
+  // @param buffer_size The size of the buffer.
+  // @{
+  void AddBuffer(size_t buffer_size);
+  void RemoveBuffer(size_t buffer_size);
+  // @}
+
+  // Forgets the bytes consumed by a writer that is going away, so that the
+  // totals only reflect the writers that are still active.
+  // @param bytes_consumed The bytes consumed by the writer over its lifetime.
+  void RemoveBytesConsumed(uint64 bytes_consumed);
+
+  // @name Accessors.
+  // @{
+  // @returns the number of buffers currently queued.
+  size_t queue_depth() const;
+  // @returns the highest number of buffers that have been queued at once.
+  size_t max_queue_depth() const;
+  // @returns the number of bytes spanned by the buffers currently queued.
+  size_t bytes_queued() const;
+  // @returns the total size of the buffers consumed.
+  uint64 bytes_consumed() const;
+  // @}
+
+ private:
+  friend class base::RefCountedThreadSafe<WriteQueueCounters>;
+  ~WriteQueueCounters();
+
+  // Protects the counters.
+  mutable base::Lock lock_;
+
+  size_t queue_depth_;  // Under lock_.
+  size_t max_queue_depth_;  // Under lock_.
+  size_t bytes_queued_;  // Under lock_.
+  uint64 bytes_consumed_;  // Under lock_.
+
+  DISALLOW_COPY_AND_ASSIGN(WriteQueueCounters);
+};
+
 // This class implements the interface the buffer consumer thread uses to
 // process incoming buffers.
-class SessionTraceFileWriter : public BufferConsumer {
+//
+// Buffers are committed to disk using overlapped I/O: up to
+// kMaxWritesInFlight writes are kept outstanding on the trace file, and while
+// they are outstanding incoming buffers are queued. Runs of queued buffers are
+// then coalesced into a single gather write where their alignment permits.
+// Each buffer stays mapped until the write containing it has completed, at
+// which point it is recycled.
+//
+// The writer may optionally compress each segment before writing it, if that
+// saves space. Compression runs on the writer's message loop, and compressed
+// segments are written on their own, rather than coalesced.
+//
+// The writer may also append an index of the segments to the trace file. The
+// index is written on the writer's message loop once the session has closed.
+//
+// Finally, the writer may rotate the trace file, starting a new chunk once the
+// current one has grown past a given size or age. Each chunk is a trace file
+// in its own right: it has its own header, with fresh clock information, and
+// starts with the attach events of the modules still loaded in the process.
+// A chunk is closed once its last write has completed, at which point the
+// chunk callback is run so that it may be processed while tracing continues.
+class SessionTraceFileWriter
+    : public BufferConsumer,
+      public base::MessageLoopForIO::IOHandler {
  public:
+  // The maximum number of writes kept in flight on the trace file.
+  static const size_t kMaxWritesInFlight = 4;
+
+  // The maximum number of buffers coalesced into a single write.
+  static const size_t kMaxBuffersPerWrite = 8;
+
+  // The callback run with the path of each trace file, or of each chunk of a
+  // rotated trace file, once it has been written in full and closed. This is
+  // run on the writer's message loop.
+  typedef base::Callback<void(const base::FilePath&)> ChunkCallback;
+
   // Construct a SessionTraceFileWriter instance.
   // @param message_loop The message loop on which this writer instance will
   //     consume buffers. The writer instance does NOT take ownership of the
-  //     message_loop. The message_loop must outlive the writer instance.
+  //     message_loop. The message_loop must outlive the writer instance, and
+  //     must be an IO message loop.
   // @param trace_directory The directory into which this writer instance will
   //     write the trace file.
   SessionTraceFileWriter(base::MessageLoop* message_loop,
                          const base::FilePath& trace_directory);
 
+  // Construct a SessionTraceFileWriter instance that also accounts for its
+  // queued buffers in a set of counters shared by all of the writers using
+  // @p message_loop.
+  // @param message_loop The message loop on which this writer instance will
+  //     consume buffers. See above.
+  // @param trace_directory The directory into which this writer instance will
+  //     write the trace file.
+  // @param message_loop_counters The counters shared by the writers using
+  //     @p message_loop. The writer keeps a reference to them.
+  SessionTraceFileWriter(base::MessageLoop* message_loop,
+                         const base::FilePath& trace_directory,
+                         WriteQueueCounters* message_loop_counters);
+
   // Initialize this trace file writer.
   // @name BufferConsumer implementation.
   // @{
@@ -54,20 +160,191 @@ class SessionTraceFileWriter : public BufferConsumer {
   virtual size_t block_size() const OVERRIDE;
   // @}
 
+  // @name base::MessageLoopForIO::IOHandler implementation.
+  // @{
+  virtual void OnIOCompleted(base::MessageLoopForIO::IOContext* context,
+                             DWORD bytes_transferred,
+                             DWORD error) OVERRIDE;
+  // @}
+
+  // Sets whether this writer compresses the segments it writes. This must be
+  // set before the writer consumes any buffers.
+  void set_compress_segments(bool compress_segments) {
+    compress_segments_ = compress_segments;
+  }
+
+  // Sets whether this writer appends an index of the segments to the trace
+  // file. This must be set before the writer consumes any buffers.
+  void set_write_index(bool write_index) { write_index_ = write_index; }
+
+  // Sets the size of the records beyond which the trace file is rotated. A
+  // chunk always holds at least one segment, so it may exceed this size if
+  // that segment does. Zero, the default, disables size-based rotation. This
+  // must be set before the writer is opened.
+  void set_max_chunk_size(uint64 max_chunk_size) {
+    max_chunk_size_ = max_chunk_size;
+  }
+
+  // Sets the age beyond which the trace file is rotated. This is checked as
+  // segments are written, so an idle session doesn't rotate until it writes
+  // again. Zero, the default, disables time-based rotation. This must be set
+  // before the writer is opened.
+  void set_max_chunk_duration(base::TimeDelta max_chunk_duration) {
+    max_chunk_duration_ = max_chunk_duration;
+  }
+
+  // Sets the callback to be run as each trace file or chunk is completed.
+  // This must be set before the writer is opened.
+  void set_chunk_callback(const ChunkCallback& chunk_callback) {
+    chunk_callback_ = chunk_callback;
+  }
+
+  // @returns true iff the trace file is rotated.
+  bool rotates() const {
+    return max_chunk_size_ != 0 || max_chunk_duration_ > base::TimeDelta();
+  }
+
+  // @returns the counters of the buffers queued by this writer.
+  const WriteQueueCounters* counters() const { return counters_.get(); }
+
+  // @returns the message loop on which this writer consumes buffers.
+  base::MessageLoop* message_loop() const { return message_loop_; }
+
  protected:
+  virtual ~SessionTraceFileWriter();
+
+  // A buffer waiting to be, or being, written to disk.
+  struct PendingBuffer;
+
+  // An outstanding overlapped write of one or more buffers.
+  struct WriteRequest;
+
+  // A trace file being written, which is one chunk of the trace if it is
+  // rotated.
+  struct Chunk;
+
+  // A module attach event, kept so that it may be replayed at the start of
+  // each chunk.
+  struct LoadedModule {
+    uint64 timestamp;
+    TraceModuleData module_data;
+  };
+  typedef std::map<ModuleAddr, LoadedModule> LoadedModuleMap;
+
   // Commit a trace buffer to disk. This will be called on message_loop_.
   void WriteBuffer(Session* session, Buffer* buffer);
 
+  // Issues writes for the queued buffers while there is room for more writes
+  // in flight. This will be called on message_loop_.
+  void IssueWrites();
+
+  // Determines whether @p next can be appended to a gather write that
+  // currently ends with @p last.
+  bool CanCoalesce(const PendingBuffer* last, const PendingBuffer* next) const;
+
+  // Compresses the segment of @p pending_buffer, provided that saves space.
+  // This will be called on message_loop_.
+  void CompressPendingBuffer(PendingBuffer* pending_buffer);
+
+  // Writes the index and closes the trace file. This will be called on
+  // message_loop_.
+  void CloseTraceFile();
+
+  // Opens a new chunk, writing its header and the attach events of the loaded
+  // modules.
+  // @param process_info Information about the process being traced.
+  // @returns the new chunk on success, NULL otherwise.
+  Chunk* OpenChunk(const ProcessInfo& process_info);
+
+  // Replaces the current chunk with a new one. The current chunk is closed
+  // once its writes in flight have completed. This will be called on
+  // message_loop_.
+  // @param process_info Information about the process being traced.
+  // @returns true on success, false otherwise.
+  bool RotateChunk(const ProcessInfo& process_info);
+
+  // Writes the index and closes @p chunk, then runs the chunk callback and
+  // deletes the chunk.
+  void FinishChunk(Chunk* chunk);
+
+  // @param bytes_to_write The number of bytes about to be written.
+  // @returns true iff writing @p bytes_to_write more bytes of records would
+  //     take the current chunk past max_chunk_size_.
+  bool ChunkWouldOverflow(size_t bytes_to_write) const;
+
+  // Updates loaded_modules_ with the module attach and detach events in a
+  // record of data.
+  // @param data The record, containing a RecordPrefix followed by a
+  //     TraceFileSegmentHeader.
+  // @param length The maximum length of continuous data that may be
+  //     contained in the record.
+  void TrackLoadedModules(const uint8* data, size_t length);
+
+  // Writes the attach events of the loaded modules to @p writer, as a single
+  // segment.
+  // @returns true on success, false otherwise.
+  bool WriteLoadedModules(TraceFileWriter* writer);
+
+  // Clears, unmaps and recycles the buffers of a completed write, then
+  // deletes the request.
+  void CompleteWriteRequest(WriteRequest* request);
+
+  // Clears, unmaps and recycles a buffer that's done being written, then
+  // deletes it.
+  void RecyclePendingBuffer(PendingBuffer* pending_buffer);
+
   // The message loop on which this trace file writer will do IO.
   base::MessageLoop* const message_loop_;
 
   // The name of the trace file. Note that we initialize this to the trace
   // directory on construction and calculate the final trace file path on
-  // Open().
+  // Open(). The chunks of a rotated trace file are named after it.
   base::FilePath trace_file_path_;
 
-  // This is used for committing actual buffers to disk.
-  TraceFileWriter writer_;
+  // The system page size. Gather writes operate on whole pages.
+  size_t page_size_;
+
+  // The block size of the trace file, and of all of its chunks.
+  size_t block_size_;
+
+  // Whether segments are compressed before being written.
+  bool compress_segments_;
+
+  // Whether an index of the segments is appended to each chunk.
+  bool write_index_;
+
+  // @name Rotation parameters.
+  // @{
+  uint64 max_chunk_size_;
+  base::TimeDelta max_chunk_duration_;
+  ChunkCallback chunk_callback_;
+  // @}
+
+  // @name These are only accessed on message_loop_.
+  // @{
+  // The buffers waiting for a write to be issued, in the order in which they
+  // were consumed.
+  std::deque<PendingBuffer*> pending_buffers_;
+  // The number of writes currently in flight.
+  size_t writes_in_flight_;
+  // The chunk being written. This is used for committing actual buffers to
+  // disk.
+  scoped_ptr<Chunk> chunk_;
+  // The chunks that have been rotated out but still have writes in flight.
+  // These are owned.
+  std::set<Chunk*> retired_chunks_;
+  // The number of chunks opened so far.
+  size_t num_chunks_;
+  // The modules currently loaded in the process, by base address. This is
+  // only maintained if the trace file is rotated.
+  LoadedModuleMap loaded_modules_;
+  // @}
+
+  // The counters of the buffers queued by this writer.
+  scoped_refptr<WriteQueueCounters> counters_;
+
+  // The counters shared by the writers using message_loop_. This may be NULL.
+  scoped_refptr<WriteQueueCounters> message_loop_counters_;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(SessionTraceFileWriter);
@@ -23,11 +23,41 @@ namespace service {
 
 SessionTraceFileWriterFactory::SessionTraceFileWriterFactory(
     base::MessageLoop* message_loop)
-    : message_loop_(message_loop), trace_file_directory_(L".") {
+    : message_loop_(message_loop),
+      message_loops_(1, message_loop),
+      message_loop_counters_(1, new WriteQueueCounters()),
+      policy_(kRoundRobin),
+      next_message_loop_(0),
+      trace_file_directory_(L"."),
+      compress_segments_(false),
+      write_index_(false),
+      max_chunk_size_(0) {
   DCHECK(message_loop != NULL);
   DCHECK_EQ(base::MessageLoop::TYPE_IO, message_loop->type());
 }
 
+SessionTraceFileWriterFactory::SessionTraceFileWriterFactory(
+    const std::vector<base::MessageLoop*>& message_loops,
+    SchedulingPolicy policy)
+    : message_loop_(message_loops.empty() ? NULL : message_loops[0]),
+      message_loops_(message_loops),
+      policy_(policy),
+      next_message_loop_(0),
+      trace_file_directory_(L"."),
+      compress_segments_(false),
+      write_index_(false),
+      max_chunk_size_(0) {
+  DCHECK(!message_loops.empty());
+  for (size_t i = 0; i < message_loops_.size(); ++i) {
+    DCHECK(message_loops_[i] != NULL);
+    DCHECK_EQ(base::MessageLoop::TYPE_IO, message_loops_[i]->type());
+    message_loop_counters_.push_back(new WriteQueueCounters());
+  }
+}
+
+SessionTraceFileWriterFactory::~SessionTraceFileWriterFactory() {
+}
+
 bool SessionTraceFileWriterFactory::SetTraceFileDirectory(
     const base::FilePath& path) {
   DCHECK(!path.empty());
@@ -47,9 +77,48 @@ bool SessionTraceFileWriterFactory::CreateConsumer(
   DCHECK(message_loop_ != NULL);
 
   // Allocate a new trace file writer.
-  *consumer = new SessionTraceFileWriter(message_loop_, trace_file_directory_);
+  size_t index = PickMessageLoop();
+  SessionTraceFileWriter* writer = new SessionTraceFileWriter(
+      message_loops_[index],
+      trace_file_directory_,
+      message_loop_counters_[index]);
+  writer->set_compress_segments(compress_segments_);
+  writer->set_write_index(write_index_);
+  writer->set_max_chunk_size(max_chunk_size_);
+  writer->set_max_chunk_duration(max_chunk_duration_);
+  writer->set_chunk_callback(chunk_callback_);
+  *consumer = writer;
   return true;
 }
 
+const WriteQueueCounters* SessionTraceFileWriterFactory::message_loop_counters(
+    size_t index) const {
+  DCHECK_LT(index, message_loop_counters_.size());
+  return message_loop_counters_[index].get();
+}
+
+size_t SessionTraceFileWriterFactory::PickMessageLoop() {
+  base::AutoLock auto_lock(lock_);
+
+  size_t count = message_loops_.size();
+  size_t index = next_message_loop_;
+  if (policy_ == kBytesWeighted) {
+    // Scanning from the round-robin position means that ties go to the loop
+    // that has gone the longest without a new writer.
+    uint64 min_bytes = message_loop_counters_[index]->bytes_consumed();
+    for (size_t i = 1; i < count; ++i) {
+      size_t candidate = (next_message_loop_ + i) % count;
+      uint64 bytes = message_loop_counters_[candidate]->bytes_consumed();
+      if (bytes < min_bytes) {
+        index = candidate;
+        min_bytes = bytes;
+      }
+    }
+  }
+
+  next_message_loop_ = (index + 1) % count;
+  return index;
+}
+
 }  // namespace service
 }  // namespace trace
@@ -19,7 +19,10 @@
 #define SYZYGY_TRACE_SERVICE_SESSION_TRACE_FILE_WRITER_FACTORY_H_
 
 #include <set>
+#include <vector>
 
+#include "base/callback.h"
+#include "base/time.h"
 #include "base/files/file_path.h"
 #include "base/synchronization/lock.h"
 #include "base/win/scoped_handle.h"
@@ -32,11 +35,27 @@ namespace trace {
 namespace service {
 
 class SessionTraceFileWriter;
+class WriteQueueCounters;
 
 // This class creates manages buffer consumer instances for a call trace
 // service instance.
 class SessionTraceFileWriterFactory : public BufferConsumerFactory {
  public:
+  // The policies by which the trace file writers of new sessions are assigned
+  // to message loops, when there are several to choose from.
+  enum SchedulingPolicy {
+    // Message loops are handed out in turn.
+    kRoundRobin,
+    // The message loop whose active writers have consumed the fewest bytes is
+    // chosen, so that chatty sessions end up spread across the loops. Ties
+    // are broken round-robin.
+    kBytesWeighted,
+  };
+
+  // The callback run with the path of each trace file, or trace file chunk,
+  // once it is complete. This is SessionTraceFileWriter::ChunkCallback.
+  typedef base::Callback<void(const base::FilePath&)> ChunkCallback;
+
   // construct a SessionTraceFileWriterFactory instance.
   // @param message_loop The message loop on which SessionTraceFileWriter
   //     instances created by this factory will consume buffers. The factory
@@ -44,6 +63,20 @@ class SessionTraceFileWriterFactory : public BufferConsumerFactory {
   //     must outlive the factory instance.
   explicit SessionTraceFileWriterFactory(base::MessageLoop* message_loop);
 
+  // Construct a SessionTraceFileWriterFactory instance that spreads the trace
+  // file writers it creates across a pool of message loops, typically each
+  // running on its own writer thread.
+  // @param message_loops The IO message loops on which SessionTraceFileWriter
+  //     instances created by this factory will consume buffers. There must be
+  //     at least one. The factory does NOT take ownership of them, and they
+  //     must outlive the factory instance.
+  // @param policy The policy by which writers are assigned to message loops.
+  SessionTraceFileWriterFactory(
+      const std::vector<base::MessageLoop*>& message_loops,
+      SchedulingPolicy policy);
+
+  ~SessionTraceFileWriterFactory();
+
   // @name BufferConsumerFactory implementation.
   // @{
   virtual bool CreateConsumer(scoped_refptr<BufferConsumer>* consumer) OVERRIDE;
@@ -53,20 +86,93 @@ class SessionTraceFileWriterFactory : public BufferConsumerFactory {
   // file writers will output trace files.
   bool SetTraceFileDirectory(const base::FilePath& path);
 
-  // Get the message loop the trace file writers should use for IO.
+  // Sets whether subsequently created trace file writers compress the
+  // segments they write. This is off by default.
+  void set_compress_segments(bool compress_segments) {
+    compress_segments_ = compress_segments;
+  }
+
+  // @returns true iff trace file writers compress the segments they write.
+  bool compress_segments() const { return compress_segments_; }
+
+  // Sets whether subsequently created trace file writers append an index of
+  // their segments to the trace files. This is off by default.
+  void set_write_index(bool write_index) { write_index_ = write_index; }
+
+  // @returns true iff trace file writers index the trace files they write.
+  bool write_index() const { return write_index_; }
+
+  // Sets the size and age beyond which subsequently created trace file
+  // writers rotate their trace files. Zero disables either kind of rotation,
+  // and both are disabled by default.
+  // @{
+  void set_max_chunk_size(uint64 max_chunk_size) {
+    max_chunk_size_ = max_chunk_size;
+  }
+  void set_max_chunk_duration(base::TimeDelta max_chunk_duration) {
+    max_chunk_duration_ = max_chunk_duration;
+  }
+  // @}
+
+  // Sets the callback run by subsequently created trace file writers as each
+  // of their trace files or chunks is completed. The callback is run on the
+  // writer's message loop, so it must be safe to run on any of them.
+  void set_chunk_callback(const ChunkCallback& chunk_callback) {
+    chunk_callback_ = chunk_callback;
+  }
+
+  // Get the message loop the trace file writers should use for IO. When the
+  // factory has several message loops, this is the first of them.
   base::MessageLoop* message_loop() { return message_loop_; }
 
+  // @returns the number of message loops writers are spread across.
+  size_t message_loop_count() const { return message_loops_.size(); }
+
+  // @returns the counters of the buffers queued by all of the writers using
+  //     the message loop with the given @p index.
+  const WriteQueueCounters* message_loop_counters(size_t index) const;
+
  protected:
+  // Picks the message loop to be used by the next writer, according to
+  // policy_.
+  // @returns the index of the chosen message loop.
+  size_t PickMessageLoop();
+
   // The message loop the trace file writers should use for IO.
   base::MessageLoop* const message_loop_;
 
+  // The message loops among which the trace file writers are spread, and the
+  // counters shared by the writers using each of them.
+  std::vector<base::MessageLoop*> message_loops_;
+  std::vector<scoped_refptr<WriteQueueCounters>> message_loop_counters_;
+
+  // The policy by which writers are assigned to message loops.
+  SchedulingPolicy policy_;
+
+  // The message loop at which the next round-robin pick starts.
+  size_t next_message_loop_;  // Under lock_.
+
   // The directory into which trace file writers will write.
   base::FilePath trace_file_directory_;
 
+  // Whether trace file writers compress the segments they write.
+  bool compress_segments_;
+
+  // Whether trace file writers index the trace files they write.
+  bool write_index_;
+
+  // @name The rotation parameters of trace file writers.
+  // @{
+  uint64 max_chunk_size_;
+  base::TimeDelta max_chunk_duration_;
+  ChunkCallback chunk_callback_;
+  // @}
+
   // The set of currently active buffer consumer objects. Protected by lock_.
   std::set<scoped_refptr<BufferConsumer>> active_consumers_;
 
-  // Used to protect access to the set of active consumers.
+  // Used to protect access to the set of active consumers and the scheduling
+  // state.
   base::Lock lock_;
 
  private:
@@ -20,6 +20,7 @@
 #include "base/environment.h"
 #include "base/file_util.h"
 #include "base/stringprintf.h"
+#include "base/time.h"
 #include "base/utf_string_conversions.h"
 #include "base/files/scoped_temp_dir.h"
 #include "base/memory/scoped_ptr.h"
@@ -197,6 +198,26 @@ class TestSession : public Session {
     return buffer_requests_waiting_for_recycle_;
   }
 
+  void SampleBufferRequest(base::TimeTicks now) {
+    base::AutoLock lock(lock_);
+    UpdateAdaptiveBufferSize(now);
+  }
+
+  size_t pool_buffer_size() {
+    base::AutoLock lock(lock_);
+    return GetPoolBufferSize();
+  }
+
+  size_t buffer_state_count(BufferState state) {
+    base::AutoLock lock(lock_);
+    return buffer_state_counts_[state];
+  }
+
+  size_t num_buffers_dropped() {
+    base::AutoLock lock(lock_);
+    return num_buffers_dropped_;
+  }
+
   virtual void OnWaitingForBufferToBeRecycled() OVERRIDE {
     lock_.AssertAcquired();
     waiting_for_buffer_to_be_recycled_state_ = true;
@@ -381,6 +402,30 @@ void GetNextBuffer(Session* session, Buffer** buffer, bool* result) {
   *result = session->GetNextBuffer(buffer);
 }
 
+// The time the tests wait for the service to catch up with them.
+const int kWaitTimeoutMs = 10000;
+
+// Polls @p condition until it holds, or until kWaitTimeoutMs elapse.
+// @returns true if @p condition holds, false if the wait timed out.
+bool WaitUntil(const base::Callback<bool(void)>& condition) {
+  base::TimeTicks deadline = base::TimeTicks::Now() +
+      base::TimeDelta::FromMilliseconds(kWaitTimeoutMs);
+  while (!condition.Run()) {
+    if (base::TimeTicks::Now() >= deadline)
+      return false;
+    ::Sleep(1);
+  }
+  return true;
+}
+
+bool NoBufferIsPendingWrite(const TestSessionPtr& session) {
+  return session->buffer_state_count(Buffer::kPendingWrite) == 0;
+}
+
+bool RingHasNoCommittedBuffer(const BufferExchangeRing* ring) {
+  return ring->committed.size() == 0;
+}
+
 }  // namespace
 
 TEST_F(SessionTest, ReturnBufferWorksAfterSessionClose) {
@@ -577,5 +622,246 @@ TEST_F(SessionTest, LargeBufferRequestAvoidsBackPressure) {
   ASSERT_EQ(buffer3, session->last_singleton_buffer_destroyed_);
 }
 
+TEST_F(SessionTest, OverloadDropsBuffers) {
+  // Configure things so that the backlog will be easily filled.
+  call_trace_service_.set_max_buffers_pending_write(1);
+  call_trace_service_.set_overload_policy(Service::kDropBuffersOnOverload);
+  ASSERT_TRUE(call_trace_service_.Start(true));
+
+  TestSessionPtr session = call_trace_service_.CreateTestSession();
+  ASSERT_TRUE(session != NULL);
+
+  Buffer* buffer1 = NULL;
+  ASSERT_TRUE(session->GetNextBuffer(&buffer1));
+  ASSERT_TRUE(buffer1 != NULL);
+
+  Buffer* buffer2 = NULL;
+  ASSERT_TRUE(session->GetNextBuffer(&buffer2));
+  ASSERT_TRUE(buffer2 != NULL);
+
+  // The first buffer fills the backlog, as we have not allowed any buffers to
+  // be written yet. The second one gets dropped and is available right away.
+  ASSERT_TRUE(session->ReturnBuffer(buffer1));
+  ASSERT_TRUE(session->ReturnBuffer(buffer2));
+  EXPECT_EQ(1u, session->buffer_state_count(Buffer::kPendingWrite));
+  EXPECT_EQ(Buffer::kAvailable, buffer2->state);
+  EXPECT_EQ(1u, session->num_buffers_dropped());
+
+  // Getting another buffer doesn't wait for the writer.
+  session->ClearWaitingForBufferToBeRecycledState();
+  Buffer* buffer3 = NULL;
+  ASSERT_TRUE(session->GetNextBuffer(&buffer3));
+  EXPECT_EQ(buffer2, buffer3);
+  EXPECT_FALSE(session->waiting_for_buffer_to_be_recycled_state_);
+
+  // Once the backlog clears, the next buffer returned is preceded by a record
+  // of the dropped buffer.
+  session->AllowBuffersToBeRecycled(1);
+  ASSERT_TRUE(WaitUntil(base::Bind(&NoBufferIsPendingWrite, session)));
+  ASSERT_TRUE(session->ReturnBuffer(buffer3));
+  EXPECT_EQ(0u, session->num_buffers_dropped());
+  EXPECT_EQ(2u, session->buffer_state_count(Buffer::kPendingWrite));
+
+  session->AllowBuffersToBeRecycled(9999);
+}
+
+TEST(WriteQueueCountersTest, CountsBuffers) {
+  scoped_refptr<WriteQueueCounters> counters(new WriteQueueCounters());
+  EXPECT_EQ(0u, counters->queue_depth());
+  EXPECT_EQ(0u, counters->bytes_queued());
+
+  counters->AddBuffer(100);
+  counters->AddBuffer(200);
+  EXPECT_EQ(2u, counters->queue_depth());
+  EXPECT_EQ(300u, counters->bytes_queued());
+
+  counters->RemoveBuffer(100);
+  counters->AddBuffer(50);
+  counters->RemoveBuffer(200);
+  EXPECT_EQ(1u, counters->queue_depth());
+  EXPECT_EQ(2u, counters->max_queue_depth());
+  EXPECT_EQ(50u, counters->bytes_queued());
+  EXPECT_EQ(350u, counters->bytes_consumed());
+
+  counters->RemoveBytesConsumed(300);
+  EXPECT_EQ(50u, counters->bytes_consumed());
+}
+
+TEST_F(SessionTest, AdaptiveBufferSizing) {
+  call_trace_service_.set_max_buffer_size_in_bytes(4 * 8192);
+  ASSERT_TRUE(call_trace_service_.Start(true));
+
+  TestSessionPtr session = call_trace_service_.CreateTestSession();
+  ASSERT_TRUE(session != NULL);
+
+  // The session's buffers are accounted for by the service.
+  Buffer* buffer = NULL;
+  ASSERT_TRUE(session->GetNextBuffer(&buffer));
+  ASSERT_TRUE(buffer != NULL);
+  EXPECT_LE(buffer->mapping_size, call_trace_service_.buffer_memory_in_use());
+
+  call_trace_service_.set_adaptive_buffer_sizing(true);
+  EXPECT_EQ(8192u, session->pool_buffer_size());
+
+  // A client requesting buffers often gets bigger buffers, up to the maximum.
+  const base::TimeDelta kPeriod = base::TimeDelta::FromMilliseconds(
+      Session::kAdaptiveSamplingPeriodMs);
+  base::TimeTicks now = base::TimeTicks::Now();
+  for (size_t i = 0; i < 3; ++i) {
+    for (size_t j = 0; j < Session::kGrowBufferRequestsPerSecond; ++j)
+      session->SampleBufferRequest(now);
+    now += kPeriod;
+    session->SampleBufferRequest(now);
+  }
+  EXPECT_EQ(4u * 8192, session->pool_buffer_size());
+
+  // Once it goes idle, its buffers shrink again.
+  now += kPeriod * 10;
+  session->SampleBufferRequest(now);
+  EXPECT_EQ(2u * 8192, session->pool_buffer_size());
+
+  // Growth is bounded by the memory budget.
+  call_trace_service_.set_buffer_memory_budget(
+      call_trace_service_.buffer_memory_in_use());
+  EXPECT_EQ(8192u, session->pool_buffer_size());
+
+  ASSERT_TRUE(session->ReturnBuffer(buffer));
+  session->AllowBuffersToBeRecycled(9999);
+}
+
+TEST_F(SessionTest, WriteClockSample) {
+  ASSERT_TRUE(call_trace_service_.Start(true));
+
+  TestSessionPtr session = call_trace_service_.CreateTestSession();
+  ASSERT_TRUE(session != NULL);
+
+  TraceClockSample clock_sample = {};
+  trace::common::GetClockSample(&clock_sample.reference);
+  clock_sample.sample = clock_sample.reference;
+  clock_sample.qpc_frequency = trace::common::GetQpcFrequency();
+
+  // The sample is handed straight to the consumer, in a buffer of its own
+  // taken from a regular pool.
+  ASSERT_TRUE(session->WriteClockSample(clock_sample));
+  EXPECT_EQ(1u, session->buffer_state_count(Buffer::kPendingWrite));
+  EXPECT_EQ(1u, session->buffer_state_count(Buffer::kAvailable));
+
+  // Once the session is closing, samples are silently dropped.
+  ASSERT_TRUE(session->Close());
+  size_t num_pending_writes =
+      session->buffer_state_count(Buffer::kPendingWrite);
+  ASSERT_TRUE(session->WriteClockSample(clock_sample));
+  EXPECT_EQ(num_pending_writes,
+            session->buffer_state_count(Buffer::kPendingWrite));
+
+  session->AllowBuffersToBeRecycled(9999);
+}
+
+TEST_F(SessionTest, ExchangeRing) {
+  ASSERT_TRUE(call_trace_service_.Start(true));
+
+  TestSessionPtr session = call_trace_service_.CreateTestSession();
+  ASSERT_TRUE(session != NULL);
+
+  // This allocates a pool of two buffers, leaving one available.
+  Buffer* buffer1 = NULL;
+  ASSERT_TRUE(session->GetNextBuffer(&buffer1));
+  ASSERT_TRUE(buffer1 != NULL);
+
+  // The test session hands us its own handles.
+  HANDLE ring_handle = NULL;
+  HANDLE event_handle = NULL;
+  ASSERT_TRUE(session->CreateExchangeRing(&ring_handle, &event_handle));
+  ASSERT_FALSE(session->CreateExchangeRing(&ring_handle, &event_handle));
+  BufferExchangeRing* ring = reinterpret_cast<BufferExchangeRing*>(
+      ::MapViewOfFile(ring_handle, FILE_MAP_WRITE, 0, 0,
+                      sizeof(BufferExchangeRing)));
+  ASSERT_TRUE(ring != NULL);
+
+  // The available buffer is offered in the ring.
+  EXPECT_EQ(1u, ring->available.size());
+  EXPECT_EQ(0u, ring->committed.size());
+  BufferExchangeEntry entry = {};
+  ASSERT_TRUE(ring->available.Pop(&entry));
+  CallTraceBuffer call_trace_buffer = {};
+  call_trace_buffer.shared_memory_handle = entry.shared_memory_handle;
+  call_trace_buffer.mapping_size = entry.mapping_size;
+  call_trace_buffer.buffer_offset = entry.buffer_offset;
+  call_trace_buffer.buffer_size = entry.buffer_size;
+  Buffer* buffer2 = NULL;
+  ASSERT_TRUE(session->FindBuffer(&call_trace_buffer, &buffer2));
+  EXPECT_NE(buffer1, buffer2);
+  EXPECT_EQ(Buffer::kInUse, buffer2->state);
+
+  // Committing a buffer to the ring schedules it for writing.
+  entry.shared_memory_handle = buffer1->shared_memory_handle;
+  entry.mapping_size = buffer1->mapping_size;
+  entry.buffer_offset = buffer1->buffer_offset;
+  entry.buffer_size = buffer1->buffer_size;
+  ASSERT_TRUE(ring->committed.Push(entry));
+  ASSERT_TRUE(::SetEvent(event_handle));
+  ASSERT_TRUE(WaitUntil(base::Bind(&RingHasNoCommittedBuffer, ring)));
+  ASSERT_TRUE(session->Close());
+  EXPECT_EQ(Buffer::kPendingWrite, buffer1->state);
+  EXPECT_EQ(Buffer::kPendingWrite, buffer2->state);
+
+  ASSERT_TRUE(::UnmapViewOfFile(ring));
+  session->AllowBuffersToBeRecycled(9999);
+}
+
+namespace {
+
+class TestSchedulingFactory : public SessionTraceFileWriterFactory {
+ public:
+  TestSchedulingFactory(const std::vector<base::MessageLoop*>& message_loops,
+                        SchedulingPolicy policy)
+      : SessionTraceFileWriterFactory(message_loops, policy) {
+  }
+
+  using SessionTraceFileWriterFactory::message_loop_counters_;
+
+  base::MessageLoop* CreateConsumerAndGetMessageLoop() {
+    scoped_refptr<BufferConsumer> consumer;
+    EXPECT_TRUE(CreateConsumer(&consumer));
+    return static_cast<SessionTraceFileWriter*>(
+        consumer.get())->message_loop();
+  }
+};
+
+}  // namespace
+
+TEST(SessionTraceFileWriterFactoryTest, SchedulingPolicies) {
+  base::Thread thread0("scheduling-test-thread-0");
+  base::Thread thread1("scheduling-test-thread-1");
+  ASSERT_TRUE(thread0.StartWithOptions(
+      base::Thread::Options(MessageLoop::TYPE_IO, 0)));
+  ASSERT_TRUE(thread1.StartWithOptions(
+      base::Thread::Options(MessageLoop::TYPE_IO, 0)));
+
+  std::vector<base::MessageLoop*> message_loops;
+  message_loops.push_back(thread0.message_loop());
+  message_loops.push_back(thread1.message_loop());
+
+  // Round-robin alternates between the loops.
+  TestSchedulingFactory round_robin(message_loops,
+                                    SessionTraceFileWriterFactory::kRoundRobin);
+  EXPECT_EQ(2u, round_robin.message_loop_count());
+  EXPECT_EQ(message_loops[0], round_robin.CreateConsumerAndGetMessageLoop());
+  EXPECT_EQ(message_loops[1], round_robin.CreateConsumerAndGetMessageLoop());
+  EXPECT_EQ(message_loops[0], round_robin.CreateConsumerAndGetMessageLoop());
+
+  // Bytes-weighted sticks to the loop that has consumed the least, breaking
+  // ties round-robin.
+  TestSchedulingFactory bytes_weighted(
+      message_loops, SessionTraceFileWriterFactory::kBytesWeighted);
+  EXPECT_EQ(message_loops[0], bytes_weighted.CreateConsumerAndGetMessageLoop());
+  EXPECT_EQ(message_loops[1], bytes_weighted.CreateConsumerAndGetMessageLoop());
+  bytes_weighted.message_loop_counters_[0]->AddBuffer(4096);
+  EXPECT_EQ(message_loops[1], bytes_weighted.CreateConsumerAndGetMessageLoop());
+  EXPECT_EQ(message_loops[1], bytes_weighted.CreateConsumerAndGetMessageLoop());
+  EXPECT_EQ(4096u, bytes_weighted.message_loop_counters(0)->bytes_queued());
+  bytes_weighted.message_loop_counters_[0]->RemoveBuffer(4096);
+}
+
 }  // namespace service
 }  // namespace trace
@@ -16,11 +16,15 @@
 
 #include <time.h>
 
+#include <algorithm>
+
 #include "base/stringprintf.h"
 #include "sawbuck/common/com_utils.h"
 #include "syzygy/common/align.h"
 #include "syzygy/common/buffer_writer.h"
 #include "syzygy/common/path_util.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/core/zstream.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 
 namespace trace {
@@ -28,7 +32,32 @@ namespace service {
 
 namespace {
 
+// An OutStream that writes to a fixed size buffer, failing once it is full.
+class BoundedOutStream : public core::OutStream {
+ public:
+  BoundedOutStream(uint8* begin, uint8* end)
+      : begin_(begin), next_(begin), end_(end) {
+    DCHECK(begin <= end);
+  }
+
+  virtual bool Write(size_t length, const core::Byte* bytes) OVERRIDE {
+    if (length > static_cast<size_t>(end_ - next_))
+      return false;
+    ::memcpy(next_, bytes, length);
+    next_ += length;
+    return true;
+  }
+
+  size_t bytes_written() const { return next_ - begin_; }
+
+ private:
+  uint8* begin_;
+  uint8* next_;
+  uint8* end_;
+};
+
 bool OpenTraceFile(const base::FilePath& file_path,
+                   DWORD extra_flags,
                    base::win::ScopedHandle* file_handle) {
   DCHECK(!file_path.empty());
   DCHECK(file_handle != NULL);
@@ -40,7 +69,8 @@ bool OpenTraceFile(const base::FilePath& file_path,
                    FILE_SHARE_DELETE | FILE_SHARE_READ,
                    NULL, /* lpSecurityAttributes */
                    CREATE_ALWAYS,
-                   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING,
+                   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING |
+                       extra_flags,
                    NULL /* hTemplateFile */));
   if (!new_file_handle.IsValid()) {
     DWORD error = ::GetLastError();
@@ -82,7 +112,9 @@ bool GetBlockSize(const base::FilePath& path, size_t* block_size) {
 
 }  // namespace
 
-TraceFileWriter::TraceFileWriter() : block_size_(0) {
+TraceFileWriter::TraceFileWriter()
+    : block_size_(0), io_mode_(kSynchronousIo), next_write_offset_(0),
+      write_index_(false) {
 }
 
 TraceFileWriter::~TraceFileWriter() {
@@ -111,9 +143,14 @@ base::FilePath TraceFileWriter::GenerateTraceFileBaseName(
 }
 
 bool TraceFileWriter::Open(const base::FilePath& path) {
+  return Open(path, kSynchronousIo);
+}
+
+bool TraceFileWriter::Open(const base::FilePath& path, IoMode io_mode) {
   // Open the trace file.
+  DWORD extra_flags = io_mode == kOverlappedIo ? FILE_FLAG_OVERLAPPED : 0;
   base::win::ScopedHandle temp_handle;
-  if (!OpenTraceFile(path, &temp_handle)) {
+  if (!OpenTraceFile(path, extra_flags, &temp_handle)) {
     LOG(ERROR) << "Failed to open trace file: '"
                << path_.value() << "'.";
     return false;
@@ -129,11 +166,18 @@ bool TraceFileWriter::Open(const base::FilePath& path) {
   path_ = path;
   handle_.Set(temp_handle.Take());
   block_size_ = block_size;
+  io_mode_ = io_mode;
+  next_write_offset_ = 0;
 
   return true;
 }
 
-bool TraceFileWriter::WriteHeader(const ProcessInfo& process_info) {
+bool TraceFileWriter::BuildHeader(const ProcessInfo& process_info,
+                                  size_t block_size,
+                                  std::vector<uint8>* buffer) {
+  DCHECK_LT(0u, block_size);
+  DCHECK(buffer != NULL);
+
   // Make sure we record the path to the executable as a path with a drive
   // letter, rather than using device names.
   base::FilePath drive_path;
@@ -143,12 +187,12 @@ bool TraceFileWriter::WriteHeader(const ProcessInfo& process_info) {
   }
 
   // Allocate an initial buffer to which to write the trace file header.
-  std::vector<uint8> buffer;
-  buffer.reserve(32 * 1024);
+  buffer->clear();
+  buffer->reserve(32 * 1024);
 
   // Skip past the fixed sized portion of the header and populate the variable
   // length fields.
-  ::common::VectorBufferWriter writer(&buffer);
+  ::common::VectorBufferWriter writer(buffer);
   if (!writer.Consume(offsetof(TraceFileHeader, blob_data)) ||
       !writer.WriteString(drive_path.value()) ||
       !writer.WriteString(process_info.command_line) ||
@@ -158,14 +202,14 @@ bool TraceFileWriter::WriteHeader(const ProcessInfo& process_info) {
   }
 
   // Go back and populate the fixed sized portion of the header.
-  TraceFileHeader* header = reinterpret_cast<TraceFileHeader*>(&buffer[0]);
+  TraceFileHeader* header = reinterpret_cast<TraceFileHeader*>(&(*buffer)[0]);
   ::memcpy(&header->signature,
            &TraceFileHeader::kSignatureValue,
            sizeof(header->signature));
   header->server_version.lo = TRACE_VERSION_LO;
   header->server_version.hi = TRACE_VERSION_HI;
-  header->header_size = buffer.size();
-  header->block_size = block_size_;
+  header->header_size = buffer->size();
+  header->block_size = block_size;
   header->process_id = process_info.process_id;
   header->module_base_address = process_info.exe_base_address;
   header->module_size = process_info.exe_image_size;
@@ -177,15 +221,19 @@ bool TraceFileWriter::WriteHeader(const ProcessInfo& process_info) {
   trace::common::GetClockInfo(&header->clock_info);
 
   // Align the header buffer up to the block size.
-  writer.Align(block_size_);
+  writer.Align(block_size);
+
+  return true;
+}
+
+bool TraceFileWriter::WriteHeader(const ProcessInfo& process_info) {
+  std::vector<uint8> buffer;
+  if (!BuildHeader(process_info, block_size_, &buffer))
+    return false;
 
   // Commit the header page to disk.
-  DWORD bytes_written = 0;
-  if (!::WriteFile(handle_.Get(), &buffer[0], buffer.size(), &bytes_written,
-                   NULL) || bytes_written != buffer.size() ) {
-    DWORD error = ::GetLastError();
-    LOG(ERROR) << "Failed writing trace file header: " << com::LogWe(error)
-               << ".";
+  if (!WriteAtEnd(&buffer[0], buffer.size())) {
+    LOG(ERROR) << "Failed writing trace file header.";
     return false;
   }
 
@@ -195,6 +243,35 @@ bool TraceFileWriter::WriteHeader(const ProcessInfo& process_info) {
 bool TraceFileWriter::WriteRecord(const void* data, size_t length) {
   DCHECK(data != NULL);
 
+  size_t bytes_to_write = 0;
+  if (!GetRecordWriteSize(data, length, &bytes_to_write))
+    return false;
+
+  if (bytes_to_write == 0) {
+    LOG(INFO) << "Not writing empty buffer.";
+    return true;
+  }
+
+  // Commit the buffer to disk.
+  uint64 offset = next_write_offset_;
+  if (!WriteAtEnd(data, bytes_to_write))
+    return false;
+
+  if (write_index_) {
+    TraceFileIndexEntry entry = {};
+    GetRecordIndexEntry(data, length, &entry);
+    AddIndexEntry(offset, entry);
+  }
+
+  return true;
+}
+
+bool TraceFileWriter::GetRecordWriteSize(const void* data,
+                                         size_t length,
+                                         size_t* bytes_to_write) const {
+  DCHECK(data != NULL);
+  DCHECK(bytes_to_write != NULL);
+
   const size_t kHeaderLength =
       sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
 
@@ -220,31 +297,249 @@ bool TraceFileWriter::WriteRecord(const void* data, size_t length) {
       reinterpret_cast<const TraceFileSegmentHeader*>(record + 1);
   size_t segment_length = header->segment_length;
   if (segment_length == 0) {
-    LOG(INFO) << "Not writing empty buffer.";
+    *bytes_to_write = 0;
     return true;
   }
 
   // Figure out the total size that we'll write to disk.
-  size_t bytes_to_write = ::common::AlignUp(kHeaderLength + segment_length,
+  size_t aligned_length = ::common::AlignUp(kHeaderLength + segment_length,
                                             block_size_);
 
   // Ensure that the total number of bytes to write does not exceed the
   // maximum record length.
-  if (bytes_to_write > length) {
+  if (aligned_length > length) {
     LOG(ERROR) << "Dropped buffer: bytes written exceeds buffer size.";
     return false;
   }
 
-  // Commit the buffer to disk.
-  // TODO(rogerm): Use overlapped I/O.
-  DCHECK_LT(0u, bytes_to_write);
+  *bytes_to_write = aligned_length;
+  return true;
+}
+
+bool TraceFileWriter::CompressRecord(const void* data,
+                                     size_t length,
+                                     void* compressed,
+                                     size_t compressed_length,
+                                     size_t* bytes_to_write) const {
+  DCHECK(data != NULL);
+  DCHECK(compressed != NULL);
+  DCHECK(bytes_to_write != NULL);
+
+  const size_t kSegmentHeaderLength =
+      sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
+  const size_t kHeaderLength =
+      sizeof(RecordPrefix) + sizeof(TraceFileCompressedSegmentHeader);
+  if (length < kSegmentHeaderLength || compressed_length <= kHeaderLength)
+    return false;
+
+  const RecordPrefix* record = reinterpret_cast<const RecordPrefix*>(data);
+  const TraceFileSegmentHeader* header =
+      reinterpret_cast<const TraceFileSegmentHeader*>(record + 1);
+  DCHECK_EQ(TraceFileSegmentHeader::kTypeId, record->type);
+
+  // The client may have changed the length since the record was validated,
+  // so we read it only once and check it again.
+  size_t segment_length = header->segment_length;
+  if (segment_length == 0 || segment_length > length - kSegmentHeaderLength) {
+    LOG(ERROR) << "Not compressing buffer: invalid segment length.";
+    return false;
+  }
+
+  // Compress straight into the output.
+  uint8* begin = reinterpret_cast<uint8*>(compressed);
+  BoundedOutStream out_stream(begin + kHeaderLength, begin + compressed_length);
+  core::ZOutStream zstream(&out_stream);
+  if (!zstream.Init(core::ZOutStream::kZDefaultCompression) ||
+      !zstream.Write(segment_length,
+                     reinterpret_cast<const uint8*>(header + 1)) ||
+      !zstream.Flush()) {
+    return false;
+  }
+
+  size_t aligned_length = ::common::AlignUp(
+      kHeaderLength + out_stream.bytes_written(), block_size_);
+  if (aligned_length > compressed_length)
+    return false;
+
+  RecordPrefix* compressed_record = reinterpret_cast<RecordPrefix*>(begin);
+  compressed_record->timestamp = record->timestamp;
+  compressed_record->size = sizeof(TraceFileCompressedSegmentHeader);
+  compressed_record->type = TraceFileCompressedSegmentHeader::kTypeId;
+  compressed_record->version.hi = TRACE_VERSION_HI;
+  compressed_record->version.lo = TRACE_VERSION_LO;
+
+  TraceFileCompressedSegmentHeader* compressed_header =
+      reinterpret_cast<TraceFileCompressedSegmentHeader*>(
+          compressed_record + 1);
+  compressed_header->thread_id = header->thread_id;
+  compressed_header->segment_length = out_stream.bytes_written();
+  compressed_header->uncompressed_length = segment_length;
+  compressed_header->compression =
+      TraceFileCompressedSegmentHeader::kZlibCompression;
+
+  // Don't leave stale memory in the padding.
+  uint8* padding = begin + kHeaderLength + out_stream.bytes_written();
+  ::memset(padding, 0, begin + aligned_length - padding);
+
+  *bytes_to_write = aligned_length;
+  return true;
+}
+
+size_t TraceFileWriter::GetCompressedRecordBound(size_t bytes_to_write) const {
+  // This is the worst case expansion of deflate, as per zlib's compressBound,
+  // plus some leeway for the headers.
+  size_t bound = bytes_to_write + (bytes_to_write >> 12) +
+      (bytes_to_write >> 14) + (bytes_to_write >> 25) + 13 +
+      sizeof(TraceFileCompressedSegmentHeader);
+  return ::common::AlignUp(bound, block_size_);
+}
+
+uint64 TraceFileWriter::ReserveRecordSpace(size_t bytes_to_write) {
+  DCHECK_LT(0u, block_size_);
+  DCHECK_EQ(0u, bytes_to_write % block_size_);
+
+  uint64 offset = next_write_offset_;
+  next_write_offset_ += bytes_to_write;
+  return offset;
+}
+
+void TraceFileWriter::GetRecordIndexEntry(const void* data,
+                                          size_t length,
+                                          TraceFileIndexEntry* entry) const {
+  DCHECK(data != NULL);
+  DCHECK(entry != NULL);
+
+  const size_t kHeaderLength =
+      sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
+  DCHECK_LE(kHeaderLength, length);
+
+  const RecordPrefix* record = reinterpret_cast<const RecordPrefix*>(data);
+  const TraceFileSegmentHeader* header =
+      reinterpret_cast<const TraceFileSegmentHeader*>(record + 1);
+  DCHECK_EQ(TraceFileSegmentHeader::kTypeId, record->type);
+
+  ::memset(entry, 0, sizeof(*entry));
+  entry->first_timestamp = record->timestamp;
+  entry->last_timestamp = record->timestamp;
+  entry->thread_id = header->thread_id;
+
+  // The client may have changed the length since the record was validated,
+  // so we read it only once and keep the walk within the buffer.
+  size_t segment_length = std::min(static_cast<size_t>(header->segment_length),
+                                   length - kHeaderLength);
+  const uint8* next = reinterpret_cast<const uint8*>(header + 1);
+  const uint8* end = next + segment_length;
+  bool seen_record = false;
+  while (static_cast<size_t>(end - next) >= sizeof(RecordPrefix)) {
+    const RecordPrefix* prefix = reinterpret_cast<const RecordPrefix*>(next);
+    size_t remaining = end - next - sizeof(RecordPrefix);
+    if (prefix->size > remaining)
+      break;
+    next += sizeof(RecordPrefix) + prefix->size;
+
+    if (!seen_record || prefix->timestamp < entry->first_timestamp)
+      entry->first_timestamp = prefix->timestamp;
+    if (!seen_record || prefix->timestamp > entry->last_timestamp)
+      entry->last_timestamp = prefix->timestamp;
+    seen_record = true;
+
+    if (prefix->type >= TraceFileIndexEntry::kFirstCountedType) {
+      size_t type_index = prefix->type - TraceFileIndexEntry::kFirstCountedType;
+      if (type_index < TraceFileIndexEntry::kNumCountedTypes)
+        ++entry->record_counts[type_index];
+    }
+  }
+}
+
+void TraceFileWriter::AddIndexEntry(uint64 offset,
+                                    const TraceFileIndexEntry& entry) {
+  if (!write_index_)
+    return;
+
+  DCHECK(index_entries_.empty() ||
+         index_entries_.back().segment_offset < offset);
+  index_entries_.push_back(entry);
+  index_entries_.back().segment_offset = offset;
+}
+
+bool TraceFileWriter::WriteIndex() {
+  DCHECK_LT(0u, block_size_);
+
+  const size_t kHeaderLength =
+      sizeof(RecordPrefix) + sizeof(TraceFileIndexHeader);
+  size_t index_size = kHeaderLength +
+      index_entries_.size() * sizeof(TraceFileIndexEntry);
+
+  // The footer goes at the very end of the padding, so there's always an
+  // extra block if the index fills its last block.
+  std::vector<uint8> buffer(::common::AlignUp(
+      index_size + sizeof(TraceFileIndexFooter), block_size_));
+
+  RecordPrefix* prefix = reinterpret_cast<RecordPrefix*>(&buffer[0]);
+  prefix->timestamp = trace::common::GetTsc();
+  prefix->size = sizeof(TraceFileIndexHeader);
+  prefix->type = TraceFileIndexHeader::kTypeId;
+  prefix->version.hi = TRACE_VERSION_HI;
+  prefix->version.lo = TRACE_VERSION_LO;
+
+  TraceFileIndexHeader* header =
+      reinterpret_cast<TraceFileIndexHeader*>(prefix + 1);
+  header->num_entries = index_entries_.size();
+  header->entry_size = sizeof(TraceFileIndexEntry);
+  if (!index_entries_.empty()) {
+    ::memcpy(header + 1, &index_entries_[0],
+             index_entries_.size() * sizeof(TraceFileIndexEntry));
+  }
+
+  TraceFileIndexFooter* footer = reinterpret_cast<TraceFileIndexFooter*>(
+      &buffer[buffer.size() - sizeof(TraceFileIndexFooter)]);
+  footer->index_offset = next_write_offset_;
+  footer->index_size = index_size;
+  ::memcpy(&footer->signature,
+           &TraceFileIndexFooter::kSignatureValue,
+           sizeof(footer->signature));
+
+  return WriteAtEnd(&buffer[0], buffer.size());
+}
+
+bool TraceFileWriter::WriteAtEnd(const void* data, size_t length) {
+  DCHECK(data != NULL);
+  DCHECK_LT(0u, length);
+
+  uint64 offset = ReserveRecordSpace(length);
+
+  // Files opened for overlapped I/O don't maintain a file pointer, so the
+  // offset must be provided explicitly. Setting the low-order bit of the event
+  // handle keeps the completion from being queued to a completion port that
+  // the file may be associated with; we wait on it right here.
+  OVERLAPPED overlapped = {};
+  base::win::ScopedHandle event;
+  if (io_mode_ == kOverlappedIo) {
+    event.Set(::CreateEvent(NULL, TRUE, FALSE, NULL));
+    if (!event.IsValid()) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to create event: " << com::LogWe(error) << ".";
+      return false;
+    }
+    overlapped.Offset = static_cast<DWORD>(offset);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    overlapped.hEvent = reinterpret_cast<HANDLE>(
+        reinterpret_cast<DWORD_PTR>(event.Get()) | 1);
+  }
+
   DWORD bytes_written = 0;
-  if (!::WriteFile(handle_.Get(),
-                   record,
-                   bytes_to_write,
-                   &bytes_written,
-                   NULL) ||
-      bytes_written != bytes_to_write) {
+  BOOL success = ::WriteFile(handle_.Get(),
+                             data,
+                             length,
+                             &bytes_written,
+                             io_mode_ == kOverlappedIo ? &overlapped : NULL);
+  if (!success && io_mode_ == kOverlappedIo &&
+      ::GetLastError() == ERROR_IO_PENDING) {
+    success = ::GetOverlappedResult(handle_.Get(), &overlapped,
+                                    &bytes_written, TRUE);
+  }
+
+  if (!success || bytes_written != length) {
     DWORD error = ::GetLastError();
     LOG(ERROR) << "Failed writing to '" << path_.value()
                << "': " << com::LogWe(error) << ".";
@@ -255,12 +550,18 @@ bool TraceFileWriter::WriteRecord(const void* data, size_t length) {
 }
 
 bool TraceFileWriter::Close() {
+  bool success = true;
+  if (write_index_ && handle_.IsValid() && !WriteIndex()) {
+    LOG(ERROR) << "Failed to write the trace file index.";
+    success = false;
+  }
+
   if (::CloseHandle(handle_.Take()) == 0) {
     DWORD error = ::GetLastError();
     LOG(ERROR) << "CloseHandle failed: " << com::LogWe(error) << ".";
     return false;
   }
-  return true;
+  return success;
 }
 
 }  // namespace service
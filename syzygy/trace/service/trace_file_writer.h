@@ -17,6 +17,16 @@
 // unbuffered writing to disk, and as such only writes multiples of the disk
 // sector size.
 //
+// The file may optionally be opened for overlapped I/O. In that case the
+// header and records may still be written synchronously via WriteHeader and
+// WriteRecord, but the caller may also issue its own overlapped writes to
+// handle(), at file offsets obtained from ReserveRecordSpace.
+//
+// The writer may optionally append an index of the segments it has written
+// when it is closed. Segments written via WriteRecord are indexed
+// automatically; callers issuing their own writes must describe them with
+// GetRecordIndexEntry and AddIndexEntry.
+//
 // Intended use:
 //
 //   TraceFileWriter w;
@@ -39,8 +49,12 @@
 #ifndef SYZYGY_TRACE_SERVICE_TRACE_FILE_WRITER_H_
 #define SYZYGY_TRACE_SERVICE_TRACE_FILE_WRITER_H_
 
+#include <vector>
+
+#include "base/logging.h"
 #include "base/files/file_path.h"
 #include "base/win/scoped_handle.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
 #include "syzygy/trace/service/process_info.h"
 
 namespace trace {
@@ -50,6 +64,12 @@ namespace service {
 // writing a trace file. It is not thread-safe.
 class TraceFileWriter {
  public:
+  // The ways in which a trace file may be opened.
+  enum IoMode {
+    kSynchronousIo,
+    kOverlappedIo,
+  };
+
   // Constructor.
   TraceFileWriter();
 
@@ -69,6 +89,24 @@ class TraceFileWriter {
   // @returns true on success, false otherwise.
   bool Open(const base::FilePath& path);
 
+  // Opens a trace file at the given path.
+  // @param path The path of the trace file to write.
+  // @param io_mode The type of I/O that will be performed on the file.
+  // @returns true on success, false otherwise.
+  bool Open(const base::FilePath& path, IoMode io_mode);
+
+  // Builds the header of a trace file, as written by WriteHeader. This is
+  // also how in-memory consumers of a session's buffers describe the process
+  // they pertain to.
+  // @param process_info Information about the process to which the trace
+  //     pertains.
+  // @param block_size The block size to which the header is aligned.
+  // @param buffer Receives the header, which starts with a TraceFileHeader.
+  // @returns true on success, false otherwise.
+  static bool BuildHeader(const ProcessInfo& process_info,
+                          size_t block_size,
+                          std::vector<uint8>* buffer);
+
   // Writes the header to the trace file. A trace file is associated with a
   // single running process, so we require a populated process-info struct.
   // @param process_info Information about the process to which this trace file
@@ -86,7 +124,77 @@ class TraceFileWriter {
   // @returns true on success, false otherwise.
   bool WriteRecord(const void* data, size_t length);
 
-  // Closes the trace file.
+  // Validates a record of data and determines the number of bytes that need
+  // to be committed to disk for it. This performs the same validation as
+  // WriteRecord, but doesn't write anything.
+  // @param data The record to be written. This must contain a RecordPrefix
+  //     followed by a TraceFileSegmentHeader.
+  // @param length The maximum length of continuous data that may be
+  //     contained in the record.
+  // @param bytes_to_write Receives the number of bytes to write. This will be
+  //     a multiple of block_size(), and is zero for an empty segment.
+  // @returns true if the record is valid, false otherwise.
+  bool GetRecordWriteSize(const void* data,
+                          size_t length,
+                          size_t* bytes_to_write) const;
+
+  // Compresses a record of data, producing a record whose segment header is a
+  // TraceFileCompressedSegmentHeader. This is meant to be called after
+  // GetRecordWriteSize has validated the record.
+  // @param data The record to be compressed. This must contain a RecordPrefix
+  //     followed by a non-empty TraceFileSegmentHeader segment.
+  // @param length The maximum length of continuous data that may be
+  //     contained in the record.
+  // @param compressed The buffer to receive the compressed record. Its
+  //     contents are undefined on failure.
+  // @param compressed_length The size of @p compressed. A buffer of
+  //     GetCompressedRecordBound() bytes is always sufficient.
+  // @param bytes_to_write Receives the number of bytes to write for the
+  //     compressed record. This will be a multiple of block_size(), and may
+  //     exceed the write size of the original record if it's incompressible.
+  // @returns true on success, false otherwise.
+  bool CompressRecord(const void* data,
+                      size_t length,
+                      void* compressed,
+                      size_t compressed_length,
+                      size_t* bytes_to_write) const;
+
+  // @param bytes_to_write The write size of a record, as returned by
+  //     GetRecordWriteSize.
+  // @returns the size of a buffer sufficient to hold the record once
+  //     compressed by CompressRecord, no matter its contents.
+  size_t GetCompressedRecordBound(size_t bytes_to_write) const;
+
+  // Reserves space for a record at the end of the trace file. This is meant
+  // for callers that issue their own overlapped writes to handle(); records
+  // are laid out in the order in which their space is reserved, regardless of
+  // the order in which the writes complete.
+  // @param bytes_to_write The number of bytes to reserve. This must be a
+  //     multiple of block_size().
+  // @returns the file offset at which the record is to be written.
+  uint64 ReserveRecordSpace(size_t bytes_to_write);
+
+  // Describes a record of data for the trace file index. This is meant to be
+  // called after GetRecordWriteSize has validated the record, and before it
+  // is compressed, if it is.
+  // @param data The record to be described. This must contain a RecordPrefix
+  //     followed by a TraceFileSegmentHeader.
+  // @param length The maximum length of continuous data that may be
+  //     contained in the record.
+  // @param entry Receives the description of the record. Its segment offset
+  //     is left for AddIndexEntry to fill in.
+  void GetRecordIndexEntry(const void* data,
+                           size_t length,
+                           TraceFileIndexEntry* entry) const;
+
+  // Adds a record to the trace file index. Records must be added in the order
+  // in which they're laid out in the trace file. This has no effect unless the
+  // index is being written.
+  // @param offset The file offset at which the record was written.
+  // @param entry The description of the record, as per GetRecordIndexEntry.
+  void AddIndexEntry(uint64 offset, const TraceFileIndexEntry& entry);
+
+  // Closes the trace file, first appending the index if it is being written.
   // @returns true on success, false otherwise.
   // @note If this is not called manually the trace-file will close itself when
   //     the writer goes out of scope.
@@ -100,7 +208,41 @@ class TraceFileWriter {
   // @note This is only valid after Open has returned successfully.
   size_t block_size() const { return block_size_; }
 
+  // Sets the block size without opening a trace file. This lets the record
+  // validation and compression helpers lay out a trace file that is written
+  // elsewhere, such as to a network connection. It must not be called once a
+  // trace file has been opened.
+  // @param block_size The block size to which records are aligned.
+  void set_block_size(size_t block_size) {
+    DCHECK(!handle_.IsValid());
+    DCHECK_LT(0u, block_size);
+    block_size_ = block_size;
+  }
+
+  // @returns the handle to the trace file.
+  // @note This is only valid after Open has returned successfully.
+  HANDLE handle() const { return handle_.Get(); }
+
+  // @returns the I/O mode in which the trace file was opened.
+  IoMode io_mode() const { return io_mode_; }
+
+  // Sets whether an index of the segments is written when the trace file is
+  // closed. This must be set before any records are written.
+  void set_write_index(bool write_index) { write_index_ = write_index; }
+
+  // @returns true iff an index is written when the trace file is closed.
+  bool write_index() const { return write_index_; }
+
  protected:
+  // Synchronously writes @p length bytes of @p data at the end of the trace
+  // file, regardless of the I/O mode the file was opened in.
+  // @returns true on success, false otherwise.
+  bool WriteAtEnd(const void* data, size_t length);
+
+  // Writes the index record and its footer at the end of the trace file.
+  // @returns true on success, false otherwise.
+  bool WriteIndex();
+
   // The path to the trace file being written.
   base::FilePath path_;
 
@@ -110,6 +252,18 @@ class TraceFileWriter {
   // The block size being used by the trace file writer.
   size_t block_size_;
 
+  // The I/O mode in which the trace file was opened.
+  IoMode io_mode_;
+
+  // The offset at which the next record will be written.
+  uint64 next_write_offset_;
+
+  // Whether an index is written when the trace file is closed.
+  bool write_index_;
+
+  // The entries of the index, in the order in which they were added.
+  std::vector<TraceFileIndexEntry> index_entries_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(TraceFileWriter);
 };
@@ -15,8 +15,12 @@
 #include "syzygy/trace/service/trace_file_writer.h"
 
 #include "base/file_util.h"
+#include "base/memory/scoped_ptr.h"
 #include "gtest/gtest.h"
 #include "syzygy/common/align.h"
+#include "syzygy/common/buffer_writer.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/core/zstream.h"
 #include "syzygy/pe/unittest_util.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 #include "syzygy/trace/service/process_info.h"
@@ -180,5 +184,246 @@ TEST_F(TraceFileWriterTest, WriteRecordSucceeds) {
   EXPECT_EQ(0, trace_file_size % w.block_size());
 }
 
+TEST_F(TraceFileWriterTest, WriteRecordSucceedsOverlapped) {
+  TestTraceFileWriter w;
+  ASSERT_TRUE(w.Open(trace_path, TraceFileWriter::kOverlappedIo));
+  EXPECT_EQ(TraceFileWriter::kOverlappedIo, w.io_mode());
+
+  ProcessInfo pi;
+  ASSERT_TRUE(pi.Initialize(::GetCurrentProcessId()));
+  ASSERT_TRUE(w.WriteHeader(pi));
+
+  std::vector<uint8> data;
+  data.resize(sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader) + 1);
+  RecordPrefix* record = reinterpret_cast<RecordPrefix*>(data.data());
+  TraceFileSegmentHeader* header = reinterpret_cast<TraceFileSegmentHeader*>(
+      record + 1);
+  record->size = sizeof(TraceFileSegmentHeader);
+  record->type= TraceFileSegmentHeader::kTypeId;
+  record->version.hi = TRACE_VERSION_HI;
+  record->version.lo = TRACE_VERSION_LO;
+  header->segment_length = 1;
+
+  data.resize(::common::AlignUp(data.size(), w.block_size()));
+  size_t bytes_to_write = 0;
+  EXPECT_TRUE(w.GetRecordWriteSize(data.data(), data.size(), &bytes_to_write));
+  EXPECT_EQ(w.block_size(), bytes_to_write);
+
+  // Records are appended, even without a file pointer.
+  EXPECT_TRUE(w.WriteRecord(data.data(), data.size()));
+  EXPECT_TRUE(w.WriteRecord(data.data(), data.size()));
+  uint64 end_offset = w.ReserveRecordSpace(0);
+
+  ASSERT_TRUE(w.Close());
+
+  int64 trace_file_size = 0;
+  ASSERT_TRUE(file_util::GetFileSize(trace_path, &trace_file_size));
+  EXPECT_EQ(end_offset, static_cast<uint64>(trace_file_size));
+  EXPECT_EQ(0, trace_file_size % w.block_size());
+}
+
+TEST_F(TraceFileWriterTest, GetRecordWriteSizeOfEmptySegment) {
+  TestTraceFileWriter w;
+  ASSERT_TRUE(w.Open(trace_path));
+
+  std::vector<uint8> data;
+  data.resize(w.block_size());
+  RecordPrefix* record = reinterpret_cast<RecordPrefix*>(data.data());
+  record->size = sizeof(TraceFileSegmentHeader);
+  record->type= TraceFileSegmentHeader::kTypeId;
+  record->version.hi = TRACE_VERSION_HI;
+  record->version.lo = TRACE_VERSION_LO;
+
+  size_t bytes_to_write = 1;
+  EXPECT_TRUE(w.GetRecordWriteSize(data.data(), data.size(), &bytes_to_write));
+  EXPECT_EQ(0u, bytes_to_write);
+}
+
+TEST_F(TraceFileWriterTest, GetRecordWriteSizeWithoutOpen) {
+  // Records may be laid out for a destination other than a trace file.
+  TestTraceFileWriter w;
+  w.set_block_size(512);
+
+  std::vector<uint8> data;
+  data.resize(sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader) + 1);
+  RecordPrefix* record = reinterpret_cast<RecordPrefix*>(data.data());
+  TraceFileSegmentHeader* header = reinterpret_cast<TraceFileSegmentHeader*>(
+      record + 1);
+  record->size = sizeof(TraceFileSegmentHeader);
+  record->type= TraceFileSegmentHeader::kTypeId;
+  record->version.hi = TRACE_VERSION_HI;
+  record->version.lo = TRACE_VERSION_LO;
+  header->segment_length = 1;
+
+  data.resize(512);
+  size_t bytes_to_write = 0;
+  EXPECT_TRUE(w.GetRecordWriteSize(data.data(), data.size(), &bytes_to_write));
+  EXPECT_EQ(512u, bytes_to_write);
+}
+
+TEST_F(TraceFileWriterTest, CompressRecord) {
+  TestTraceFileWriter w;
+  ASSERT_TRUE(w.Open(trace_path));
+
+  const size_t kSegmentLength = 16 * w.block_size();
+  std::vector<uint8> data;
+  data.resize(::common::AlignUp(
+      sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader) + kSegmentLength,
+      w.block_size()));
+  RecordPrefix* record = reinterpret_cast<RecordPrefix*>(data.data());
+  TraceFileSegmentHeader* header = reinterpret_cast<TraceFileSegmentHeader*>(
+      record + 1);
+  record->timestamp = 42;
+  record->size = sizeof(TraceFileSegmentHeader);
+  record->type = TraceFileSegmentHeader::kTypeId;
+  record->version.hi = TRACE_VERSION_HI;
+  record->version.lo = TRACE_VERSION_LO;
+  header->thread_id = 7;
+  header->segment_length = kSegmentLength;
+  uint8* segment = reinterpret_cast<uint8*>(header + 1);
+  for (size_t i = 0; i < kSegmentLength; ++i)
+    segment[i] = static_cast<uint8>(i % 13);
+
+  size_t bytes_to_write = 0;
+  ASSERT_TRUE(w.GetRecordWriteSize(data.data(), data.size(), &bytes_to_write));
+  std::vector<uint8> compressed(w.GetCompressedRecordBound(bytes_to_write));
+  EXPECT_LE(bytes_to_write, compressed.size());
+
+  size_t compressed_bytes_to_write = 0;
+  ASSERT_TRUE(w.CompressRecord(data.data(), bytes_to_write,
+                               compressed.data(), compressed.size(),
+                               &compressed_bytes_to_write));
+  EXPECT_LT(compressed_bytes_to_write, bytes_to_write);
+  EXPECT_EQ(0u, compressed_bytes_to_write % w.block_size());
+
+  const RecordPrefix* compressed_record =
+      reinterpret_cast<const RecordPrefix*>(compressed.data());
+  const TraceFileCompressedSegmentHeader* compressed_header =
+      reinterpret_cast<const TraceFileCompressedSegmentHeader*>(
+          compressed_record + 1);
+  EXPECT_EQ(42u, compressed_record->timestamp);
+  EXPECT_EQ(TraceFileCompressedSegmentHeader::kTypeId,
+            compressed_record->type);
+  EXPECT_EQ(sizeof(TraceFileCompressedSegmentHeader), compressed_record->size);
+  EXPECT_EQ(7u, compressed_header->thread_id);
+  EXPECT_EQ(kSegmentLength, compressed_header->uncompressed_length);
+  EXPECT_EQ(TraceFileCompressedSegmentHeader::kZlibCompression,
+            compressed_header->compression);
+  EXPECT_GE(compressed_bytes_to_write,
+            sizeof(RecordPrefix) + sizeof(TraceFileCompressedSegmentHeader) +
+                compressed_header->segment_length);
+
+  // The content decompresses to the original segment.
+  const uint8* compressed_segment =
+      reinterpret_cast<const uint8*>(compressed_header + 1);
+  scoped_ptr<core::InStream> in_stream(core::CreateByteInStream(
+      compressed_segment,
+      compressed_segment + compressed_header->segment_length));
+  core::ZInStream zstream(in_stream.get());
+  ASSERT_TRUE(zstream.Init());
+  std::vector<uint8> decompressed(kSegmentLength);
+  ASSERT_TRUE(zstream.Read(decompressed.size(), decompressed.data()));
+  EXPECT_EQ(0, ::memcmp(segment, decompressed.data(), kSegmentLength));
+
+  // A segment that no longer fits its record is refused.
+  header->segment_length = bytes_to_write;
+  EXPECT_FALSE(w.CompressRecord(data.data(), bytes_to_write,
+                                compressed.data(), compressed.size(),
+                                &compressed_bytes_to_write));
+}
+
+TEST_F(TraceFileWriterTest, WriteIndex) {
+  TestTraceFileWriter w;
+  w.set_write_index(true);
+  ASSERT_TRUE(w.Open(trace_path));
+
+  ProcessInfo pi;
+  ASSERT_TRUE(pi.Initialize(::GetCurrentProcessId()));
+  ASSERT_TRUE(w.WriteHeader(pi));
+  uint64 first_offset = w.ReserveRecordSpace(0);
+
+  // A segment holding two function entries and a process attach event, out
+  // of timestamp order.
+  const uint64 kTimestamps[] = { 200, 100, 300 };
+  const uint16 kTypes[] = {
+      TRACE_ENTER_EVENT, TRACE_PROCESS_ATTACH_EVENT, TRACE_ENTER_EVENT };
+  std::vector<uint8> data;
+  ::common::VectorBufferWriter writer(&data);
+  RecordPrefix record = {};
+  record.timestamp = 42;
+  record.size = sizeof(TraceFileSegmentHeader);
+  record.type = TraceFileSegmentHeader::kTypeId;
+  record.version.hi = TRACE_VERSION_HI;
+  record.version.lo = TRACE_VERSION_LO;
+  ASSERT_TRUE(writer.Write(record));
+  TraceFileSegmentHeader header = {};
+  header.thread_id = 7;
+  ASSERT_TRUE(writer.Write(header));
+  for (size_t i = 0; i < arraysize(kTimestamps); ++i) {
+    RecordPrefix event = {};
+    event.timestamp = kTimestamps[i];
+    event.size = 4;
+    event.type = kTypes[i];
+    ASSERT_TRUE(writer.Write(event));
+    ASSERT_TRUE(writer.Write(static_cast<uint32>(i)));
+  }
+  reinterpret_cast<TraceFileSegmentHeader*>(&data[sizeof(RecordPrefix)])->
+      segment_length = data.size() - sizeof(RecordPrefix) - sizeof(header);
+  data.resize(::common::AlignUp(data.size(), w.block_size()));
+  ASSERT_TRUE(w.WriteRecord(data.data(), data.size()));
+  uint64 second_offset = w.ReserveRecordSpace(0);
+
+  // A segment whose only record is truncated.
+  reinterpret_cast<TraceFileSegmentHeader*>(&data[sizeof(RecordPrefix)])->
+      segment_length = sizeof(RecordPrefix) - 1;
+  ASSERT_TRUE(w.WriteRecord(data.data(), data.size()));
+  uint64 index_offset = w.ReserveRecordSpace(0);
+
+  ASSERT_TRUE(w.Close());
+
+  std::string contents;
+  ASSERT_TRUE(file_util::ReadFileToString(trace_path, &contents));
+  ASSERT_LT(index_offset + sizeof(TraceFileIndexFooter), contents.size());
+  EXPECT_EQ(0u, contents.size() % w.block_size());
+
+  // The footer points back to the index.
+  const TraceFileIndexFooter* footer =
+      reinterpret_cast<const TraceFileIndexFooter*>(
+          &contents[contents.size() - sizeof(TraceFileIndexFooter)]);
+  EXPECT_EQ(0, ::memcmp(&footer->signature,
+                        &TraceFileIndexFooter::kSignatureValue,
+                        sizeof(footer->signature)));
+  EXPECT_EQ(index_offset, footer->index_offset);
+  EXPECT_EQ(sizeof(RecordPrefix) + sizeof(TraceFileIndexHeader) +
+                2 * sizeof(TraceFileIndexEntry),
+            footer->index_size);
+
+  const RecordPrefix* index_record = reinterpret_cast<const RecordPrefix*>(
+      &contents[index_offset]);
+  EXPECT_EQ(TraceFileIndexHeader::kTypeId, index_record->type);
+  EXPECT_EQ(sizeof(TraceFileIndexHeader), index_record->size);
+  const TraceFileIndexHeader* index_header =
+      reinterpret_cast<const TraceFileIndexHeader*>(index_record + 1);
+  ASSERT_EQ(2u, index_header->num_entries);
+  EXPECT_EQ(sizeof(TraceFileIndexEntry), index_header->entry_size);
+
+  const TraceFileIndexEntry* entries =
+      reinterpret_cast<const TraceFileIndexEntry*>(index_header + 1);
+  EXPECT_EQ(first_offset, entries[0].segment_offset);
+  EXPECT_EQ(7u, entries[0].thread_id);
+  EXPECT_EQ(100u, entries[0].first_timestamp);
+  EXPECT_EQ(300u, entries[0].last_timestamp);
+  EXPECT_EQ(2u, entries[0].record_counts[
+      TRACE_ENTER_EVENT - TraceFileIndexEntry::kFirstCountedType]);
+  EXPECT_EQ(1u, entries[0].record_counts[
+      TRACE_PROCESS_ATTACH_EVENT - TraceFileIndexEntry::kFirstCountedType]);
+
+  EXPECT_EQ(second_offset, entries[1].segment_offset);
+  EXPECT_EQ(42u, entries[1].first_timestamp);
+  EXPECT_EQ(42u, entries[1].last_timestamp);
+  for (size_t i = 0; i < TraceFileIndexEntry::kNumCountedTypes; ++i)
+    EXPECT_EQ(0u, entries[1].record_counts[i]);
+}
+
 }  // namespace service
 }  // namespace trace
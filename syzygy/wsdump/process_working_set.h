@@ -72,6 +72,9 @@ class ProcessWorkingSet {
   const ModuleStatsVector& module_stats() const { return module_stats_; }
 
  protected:
+  // The sampler captures working sets the same way.
+  friend class WorkingSetSampler;
+
   // These are protected members to allow unittesting them.
   typedef scoped_ptr<PSAPI_WORKING_SET_INFORMATION> ScopedWsPtr;
   static bool CaptureWorkingSet(HANDLE process, ScopedWsPtr* working_set);
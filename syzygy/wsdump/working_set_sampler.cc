@@ -0,0 +1,96 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/wsdump/working_set_sampler.h"
+
+#include <psapi.h>
+#include <algorithm>
+#include <iterator>
+
+#include "base/logging.h"
+#include "sawbuck/common/com_utils.h"
+#include "syzygy/core/address_space.h"
+#include "syzygy/wsdump/process_working_set.h"
+
+namespace wsdump {
+
+WorkingSetSampler::WorkingSetSampler() : process_id_(0) {
+}
+
+bool WorkingSetSampler::Initialize(DWORD process_id) {
+  // SYNCHRONIZE allows the caller to wait on the process exiting.
+  const DWORD kProcessPermissions =
+      PROCESS_QUERY_INFORMATION | PROCESS_VM_READ | SYNCHRONIZE;
+  process_.Set(::OpenProcess(kProcessPermissions, FALSE, process_id));
+  if (!process_.IsValid()) {
+    DWORD err = ::GetLastError();
+    LOG(ERROR) << "OpenProcess failed: " << com::LogWe(err);
+    return false;
+  }
+
+  process_id_ = process_id;
+  start_time_ = base::TimeTicks::Now();
+  pages_.clear();
+  modules_.clear();
+  return true;
+}
+
+bool WorkingSetSampler::Sample(WorkingSetTimeline::Sample* sample) {
+  DCHECK(sample != NULL);
+  DCHECK(process_.IsValid());
+
+  sample->time_ms = static_cast<uint32>(
+      (base::TimeTicks::Now() - start_time_).InMilliseconds());
+  sample->new_modules.clear();
+  sample->new_pages.clear();
+
+  ProcessWorkingSet::ModuleAddressSpace modules;
+  if (!ProcessWorkingSet::CaptureModules(process_id_, &modules))
+    return false;
+
+  ProcessWorkingSet::ScopedWsPtr working_set;
+  if (!ProcessWorkingSet::CaptureWorkingSet(process_.Get(), &working_set))
+    return false;
+
+  ProcessWorkingSet::ModuleAddressSpace::RangeMap::const_iterator it =
+      modules.ranges().begin();
+  for (; it != modules.ranges().end(); ++it) {
+    ModuleKey key(it->first.start(), it->second);
+    if (!modules_.insert(key).second)
+      continue;
+
+    WorkingSetTimeline::Module module;
+    module.base = it->first.start();
+    module.size = static_cast<uint32>(it->first.size());
+    module.name = it->second;
+    sample->new_modules.push_back(module);
+  }
+
+  WorkingSetTimeline::Pages pages;
+  pages.reserve(working_set->NumberOfEntries);
+  for (size_t i = 0; i < working_set->NumberOfEntries; ++i) {
+    pages.push_back(
+        static_cast<uint32>(working_set->WorkingSetInfo[i].VirtualPage));
+  }
+  std::sort(pages.begin(), pages.end());
+
+  std::set_difference(pages.begin(), pages.end(),
+                      pages_.begin(), pages_.end(),
+                      std::back_inserter(sample->new_pages));
+  pages_.swap(pages);
+
+  return true;
+}
+
+}  // namespace wsdump
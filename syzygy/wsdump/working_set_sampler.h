@@ -0,0 +1,85 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the WorkingSetSampler, which repeatedly captures the working set
+// of a process and reports the pages and modules that appear between
+// captures.
+
+#ifndef SYZYGY_WSDUMP_WORKING_SET_SAMPLER_H_
+#define SYZYGY_WSDUMP_WORKING_SET_SAMPLER_H_
+
+#include <windows.h>
+#include <set>
+#include <string>
+#include <utility>
+
+#include "base/time.h"
+#include "base/win/scoped_handle.h"
+#include "syzygy/wsdump/working_set_timeline.h"
+
+namespace wsdump {
+
+// Samples the working set of a process. Sample usage:
+//
+//   WorkingSetSampler sampler;
+//   sampler.Initialize(process_id);
+//   while (...) {
+//     WorkingSetTimeline::Sample sample;
+//     sampler.Sample(&sample);
+//     writer.WriteSample(sample);
+//   }
+//
+// Each sample only holds the pages that weren't in the working set at the
+// time of the previous sample, so pages that are trimmed and faulted back in
+// show up again.
+class WorkingSetSampler {
+ public:
+  WorkingSetSampler();
+
+  // Opens the process to sample. The time of the samples is measured from
+  // this call.
+  // @param process_id the ID of the process to sample.
+  // @returns true on success, false otherwise.
+  bool Initialize(DWORD process_id);
+
+  // Captures the working set of the process and diffs it against the
+  // previous capture.
+  // @param sample receives the newly loaded modules and the newly faulted
+  //     pages.
+  // @returns true on success, false otherwise.
+  bool Sample(WorkingSetTimeline::Sample* sample);
+
+  // @returns a handle to the sampled process, which is signaled when it
+  //     exits.
+  HANDLE process() const { return process_.Get(); }
+
+ private:
+  base::win::ScopedHandle process_;
+  DWORD process_id_;
+  base::TimeTicks start_time_;
+
+  // The pages in the working set at the time of the previous sample, by
+  // increasing page number.
+  WorkingSetTimeline::Pages pages_;
+
+  // The base addresses and names of the modules seen so far.
+  typedef std::pair<uint64, std::wstring> ModuleKey;
+  std::set<ModuleKey> modules_;
+
+  DISALLOW_COPY_AND_ASSIGN(WorkingSetSampler);
+};
+
+}  // namespace wsdump
+
+#endif  // SYZYGY_WSDUMP_WORKING_SET_SAMPLER_H_
@@ -0,0 +1,70 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/wsdump/working_set_sampler.h"
+
+#include <algorithm>
+#include <functional>
+
+#include "base/string_util.h"
+#include "gtest/gtest.h"
+
+namespace wsdump {
+
+TEST(WorkingSetSamplerTest, SampleCurrentProcess) {
+  WorkingSetSampler sampler;
+  ASSERT_TRUE(sampler.Initialize(::GetCurrentProcessId()));
+
+  // The first sample holds the whole working set, and all of the modules.
+  WorkingSetTimeline::Sample sample;
+  ASSERT_TRUE(sampler.Sample(&sample));
+  EXPECT_FALSE(sample.new_pages.empty());
+  EXPECT_TRUE(std::adjacent_find(sample.new_pages.begin(),
+                                 sample.new_pages.end(),
+                                 std::greater_equal<uint32>()) ==
+                  sample.new_pages.end());
+
+  std::wstring exe_name;
+  ASSERT_TRUE(
+      ::GetModuleFileName(NULL, WriteInto(&exe_name, MAX_PATH), MAX_PATH));
+  exe_name.resize(wcslen(exe_name.c_str()));
+  bool found_exe = false;
+  for (size_t i = 0; i < sample.new_modules.size(); ++i) {
+    if (sample.new_modules[i].name == exe_name)
+      found_exe = true;
+  }
+  EXPECT_TRUE(found_exe);
+
+  // Fault in a fresh page, which must show up in the next sample along with
+  // no module that was already reported.
+  void* memory = ::VirtualAlloc(NULL, WorkingSetTimeline::kPageSize,
+                                MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+  ASSERT_TRUE(memory != NULL);
+  *reinterpret_cast<volatile char*>(memory) = 1;
+
+  uint32 page = static_cast<uint32>(
+      reinterpret_cast<uintptr_t>(memory) / WorkingSetTimeline::kPageSize);
+  WorkingSetTimeline::Sample next_sample;
+  ASSERT_TRUE(sampler.Sample(&next_sample));
+  EXPECT_LE(sample.time_ms, next_sample.time_ms);
+  EXPECT_TRUE(std::binary_search(next_sample.new_pages.begin(),
+                                 next_sample.new_pages.end(),
+                                 page));
+  for (size_t i = 0; i < next_sample.new_modules.size(); ++i)
+    EXPECT_NE(exe_name, next_sample.new_modules[i].name);
+
+  EXPECT_TRUE(::VirtualFree(memory, 0, MEM_RELEASE));
+}
+
+}  // namespace wsdump
@@ -0,0 +1,153 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/wsdump/working_set_timeline.h"
+
+#include <set>
+#include <utility>
+
+#include "base/logging.h"
+#include "base/string_util.h"
+#include "base/files/file_path.h"
+
+namespace wsdump {
+
+namespace {
+
+// @returns true if @p module is an instance of the module named
+//     @p module_name.
+bool IsModuleNamed(const WorkingSetTimeline::Module& module,
+                   const std::wstring& module_name) {
+  std::wstring base_name = base::FilePath(module.name).BaseName().value();
+  return StringToLowerASCII(base_name) == StringToLowerASCII(module_name);
+}
+
+}  // namespace
+
+// 'WSTL' in little-endian order.
+const uint32 WorkingSetTimeline::kSignature = 0x4C545357;
+const uint32 WorkingSetTimeline::kVersion = 1;
+
+bool WorkingSetTimeline::Read(core::InStream* in_stream) {
+  DCHECK(in_stream != NULL);
+
+  core::NativeBinaryInArchive in_archive(in_stream);
+  uint32 signature = 0;
+  uint32 version = 0;
+  if (!in_archive.Load(&signature) || !in_archive.Load(&version)) {
+    LOG(ERROR) << "Unable to read working set timeline header.";
+    return false;
+  }
+  if (signature != kSignature || version != kVersion) {
+    LOG(ERROR) << "Not a working set timeline, or unsupported version.";
+    return false;
+  }
+
+  Samples samples;
+  while (true) {
+    // The timeline ends wherever sampling stopped, so running out of data
+    // at a sample boundary is the normal way for it to end.
+    uint32 time_ms = 0;
+    size_t bytes_read = 0;
+    if (!in_stream->Read(sizeof(time_ms),
+                         reinterpret_cast<core::Byte*>(&time_ms),
+                         &bytes_read)) {
+      LOG(ERROR) << "Unable to read working set timeline.";
+      return false;
+    }
+    if (bytes_read == 0)
+      break;
+
+    samples.push_back(Sample());
+    Sample& sample = samples.back();
+    sample.time_ms = time_ms;
+    if (bytes_read != sizeof(time_ms) ||
+        !in_archive.Load(&sample.new_modules) ||
+        !in_archive.Load(&sample.new_pages)) {
+      LOG(ERROR) << "Truncated working set timeline sample.";
+      return false;
+    }
+  }
+
+  samples_.swap(samples);
+  return true;
+}
+
+void WorkingSetTimeline::AddSample(const Sample& sample) {
+  DCHECK(samples_.empty() || samples_.back().time_ms <= sample.time_ms);
+  samples_.push_back(sample);
+}
+
+size_t WorkingSetTimeline::CountModulePages(const std::wstring& module_name,
+                                            uint32 time_ms) const {
+  // The page ranges of each instance of the module seen so far.
+  typedef std::pair<uint32, uint32> PageRange;
+  std::vector<PageRange> instances;
+
+  // Pages are counted once per instance they belong to.
+  std::set<std::pair<size_t, uint32> > counted;
+  for (size_t i = 0; i < samples_.size(); ++i) {
+    const Sample& sample = samples_[i];
+    if (sample.time_ms > time_ms)
+      break;
+
+    for (size_t j = 0; j < sample.new_modules.size(); ++j) {
+      const Module& module = sample.new_modules[j];
+      if (!IsModuleNamed(module, module_name))
+        continue;
+      uint32 first_page = static_cast<uint32>(module.base / kPageSize);
+      uint32 page_count =
+          static_cast<uint32>((module.size + kPageSize - 1) / kPageSize);
+      instances.push_back(PageRange(first_page, first_page + page_count));
+    }
+
+    for (size_t j = 0; j < sample.new_pages.size(); ++j) {
+      uint32 page = sample.new_pages[j];
+      for (size_t k = 0; k < instances.size(); ++k) {
+        if (page >= instances[k].first && page < instances[k].second)
+          counted.insert(std::make_pair(k, page));
+      }
+    }
+  }
+
+  return counted.size();
+}
+
+WorkingSetTimelineWriter::WorkingSetTimelineWriter(core::OutStream* out_stream)
+    : out_archive_(out_stream) {
+}
+
+bool WorkingSetTimelineWriter::WriteHeader() {
+  if (!out_archive_.Save(WorkingSetTimeline::kSignature) ||
+      !out_archive_.Save(WorkingSetTimeline::kVersion) ||
+      !out_archive_.Flush()) {
+    LOG(ERROR) << "Unable to write working set timeline header.";
+    return false;
+  }
+  return true;
+}
+
+bool WorkingSetTimelineWriter::WriteSample(
+    const WorkingSetTimeline::Sample& sample) {
+  if (!out_archive_.Save(sample.time_ms) ||
+      !out_archive_.Save(sample.new_modules) ||
+      !out_archive_.Save(sample.new_pages) ||
+      !out_archive_.Flush()) {
+    LOG(ERROR) << "Unable to write working set timeline sample.";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace wsdump
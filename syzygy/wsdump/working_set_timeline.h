@@ -0,0 +1,144 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the working set timeline, a compact binary record of the growth
+// of the working set of a process over time, as captured by wsdump in
+// continuous sampling mode.
+//
+// The file format is a header followed by a sequence of samples, each saved
+// using the native binary archive:
+//
+//   uint32 signature ('WSTL') | uint32 version
+//   sample*
+//
+// Each sample records the time at which it was taken, the modules loaded
+// since the previous sample, and the pages faulted into the working set since
+// the previous sample. Pages are identified by their page number, that is
+// their virtual address divided by the page size.
+
+#ifndef SYZYGY_WSDUMP_WORKING_SET_TIMELINE_H_
+#define SYZYGY_WSDUMP_WORKING_SET_TIMELINE_H_
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "syzygy/core/serialization.h"
+
+namespace wsdump {
+
+class WorkingSetTimeline {
+ public:
+  // A module present in the process.
+  struct Module {
+    Module() : base(0), size(0) {
+    }
+
+    uint64 base;
+    uint32 size;
+    std::wstring name;
+
+    template<class OutArchive> bool Save(OutArchive* out_archive) const {
+      return out_archive->Save(base) && out_archive->Save(size) &&
+          out_archive->Save(name);
+    }
+    template<class InArchive> bool Load(InArchive* in_archive) {
+      return in_archive->Load(&base) && in_archive->Load(&size) &&
+          in_archive->Load(&name);
+    }
+  };
+  typedef std::vector<Module> Modules;
+  typedef std::vector<uint32> Pages;
+
+  // The changes to the working set since the previous sample.
+  struct Sample {
+    Sample() : time_ms(0) {
+    }
+
+    // The time at which the sample was taken, in milliseconds since sampling
+    // started.
+    uint32 time_ms;
+    // The modules loaded since the previous sample.
+    Modules new_modules;
+    // The pages faulted in since the previous sample, by increasing page
+    // number.
+    Pages new_pages;
+  };
+  typedef std::vector<Sample> Samples;
+
+  // The file signature and version.
+  static const uint32 kSignature;
+  static const uint32 kVersion;
+
+  // The page size used to compute page numbers.
+  static const size_t kPageSize = 4096;
+
+  WorkingSetTimeline() {
+  }
+
+  // Reads a whole timeline, as written by WorkingSetTimelineWriter.
+  // @param in_stream the stream to read from.
+  // @returns true on success, false otherwise.
+  bool Read(core::InStream* in_stream);
+
+  // Appends a sample to the timeline.
+  // @param sample the sample to append. Its time must not precede that of
+  //     the last sample.
+  void AddSample(const Sample& sample);
+
+  // Counts the pages of a module that were faulted into the working set up to
+  // a given time. Modules are matched on their base name, ignoring case, so
+  // that all the instances of a module that were loaded are accounted for.
+  // @param module_name the name of the module, e.g. "chrome.dll".
+  // @param time_ms the time limit, in milliseconds since sampling started.
+  // @returns the number of pages of @p module_name faulted in by
+  //     @p time_ms, counting pages that were faulted in several times only
+  //     once per module instance.
+  size_t CountModulePages(const std::wstring& module_name,
+                          uint32 time_ms) const;
+
+  // @returns the samples, by increasing time.
+  const Samples& samples() const { return samples_; }
+
+ private:
+  Samples samples_;
+
+  DISALLOW_COPY_AND_ASSIGN(WorkingSetTimeline);
+};
+
+// Streams a timeline to an output stream, one sample at a time, so that a
+// timeline is usable even if sampling is interrupted.
+class WorkingSetTimelineWriter {
+ public:
+  // @param out_stream the stream to write to. Must outlive this object.
+  explicit WorkingSetTimelineWriter(core::OutStream* out_stream);
+
+  // Writes the file header. Must be called before any sample is written.
+  // @returns true on success, false otherwise.
+  bool WriteHeader();
+
+  // Writes a sample and flushes the underlying stream.
+  // @param sample the sample to write.
+  // @returns true on success, false otherwise.
+  bool WriteSample(const WorkingSetTimeline::Sample& sample);
+
+ private:
+  core::NativeBinaryOutArchive out_archive_;
+
+  DISALLOW_COPY_AND_ASSIGN(WorkingSetTimelineWriter);
+};
+
+}  // namespace wsdump
+
+#endif  // SYZYGY_WSDUMP_WORKING_SET_TIMELINE_H_
@@ -0,0 +1,131 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/wsdump/working_set_timeline.h"
+
+#include <iterator>
+
+#include "gtest/gtest.h"
+
+namespace wsdump {
+
+namespace {
+
+const uint32 kPageSize = WorkingSetTimeline::kPageSize;
+
+WorkingSetTimeline::Module MakeModule(uint64 base,
+                                      uint32 size,
+                                      const wchar_t* name) {
+  WorkingSetTimeline::Module module;
+  module.base = base;
+  module.size = size;
+  module.name = name;
+  return module;
+}
+
+class WorkingSetTimelineTest : public testing::Test {
+ public:
+  virtual void SetUp() OVERRIDE {
+    // The module is loaded at page 16 and spans 4 pages.
+    WorkingSetTimeline::Sample sample;
+    sample.time_ms = 10;
+    sample.new_modules.push_back(
+        MakeModule(16 * kPageSize, 4 * kPageSize - 1, L"C:\\foo\\Foo.dll"));
+    sample.new_modules.push_back(
+        MakeModule(32 * kPageSize, kPageSize, L"C:\\bar.dll"));
+    sample.new_pages.push_back(3);
+    sample.new_pages.push_back(16);
+    sample.new_pages.push_back(17);
+    sample.new_pages.push_back(32);
+    samples_.push_back(sample);
+
+    // Page 16 is faulted in again after being trimmed.
+    sample = WorkingSetTimeline::Sample();
+    sample.time_ms = 20;
+    sample.new_pages.push_back(16);
+    sample.new_pages.push_back(19);
+    sample.new_pages.push_back(20);
+    samples_.push_back(sample);
+  }
+
+  WorkingSetTimeline::Samples samples_;
+};
+
+}  // namespace
+
+TEST_F(WorkingSetTimelineTest, RoundTrip) {
+  core::ByteVector bytes;
+  core::ScopedOutStreamPtr out_stream(
+      core::CreateByteOutStream(std::back_inserter(bytes)));
+  WorkingSetTimelineWriter writer(out_stream.get());
+  ASSERT_TRUE(writer.WriteHeader());
+  for (size_t i = 0; i < samples_.size(); ++i)
+    ASSERT_TRUE(writer.WriteSample(samples_[i]));
+
+  core::ScopedInStreamPtr in_stream(
+      core::CreateByteInStream(bytes.begin(), bytes.end()));
+  WorkingSetTimeline timeline;
+  ASSERT_TRUE(timeline.Read(in_stream.get()));
+  ASSERT_EQ(samples_.size(), timeline.samples().size());
+  for (size_t i = 0; i < samples_.size(); ++i) {
+    const WorkingSetTimeline::Sample& sample = timeline.samples()[i];
+    EXPECT_EQ(samples_[i].time_ms, sample.time_ms);
+    EXPECT_EQ(samples_[i].new_pages, sample.new_pages);
+    ASSERT_EQ(samples_[i].new_modules.size(), sample.new_modules.size());
+    for (size_t j = 0; j < sample.new_modules.size(); ++j) {
+      EXPECT_EQ(samples_[i].new_modules[j].base, sample.new_modules[j].base);
+      EXPECT_EQ(samples_[i].new_modules[j].size, sample.new_modules[j].size);
+      EXPECT_EQ(samples_[i].new_modules[j].name, sample.new_modules[j].name);
+    }
+  }
+}
+
+TEST_F(WorkingSetTimelineTest, ReadFailsOnTruncatedSample) {
+  core::ByteVector bytes;
+  core::ScopedOutStreamPtr out_stream(
+      core::CreateByteOutStream(std::back_inserter(bytes)));
+  WorkingSetTimelineWriter writer(out_stream.get());
+  ASSERT_TRUE(writer.WriteHeader());
+  ASSERT_TRUE(writer.WriteSample(samples_[0]));
+  bytes.resize(bytes.size() - 1);
+
+  core::ScopedInStreamPtr in_stream(
+      core::CreateByteInStream(bytes.begin(), bytes.end()));
+  WorkingSetTimeline timeline;
+  EXPECT_FALSE(timeline.Read(in_stream.get()));
+}
+
+TEST_F(WorkingSetTimelineTest, ReadFailsOnBadSignature) {
+  core::ByteVector bytes(8, 0);
+  core::ScopedInStreamPtr in_stream(
+      core::CreateByteInStream(bytes.begin(), bytes.end()));
+  WorkingSetTimeline timeline;
+  EXPECT_FALSE(timeline.Read(in_stream.get()));
+}
+
+TEST_F(WorkingSetTimelineTest, CountModulePages) {
+  WorkingSetTimeline timeline;
+  for (size_t i = 0; i < samples_.size(); ++i)
+    timeline.AddSample(samples_[i]);
+
+  EXPECT_EQ(0U, timeline.CountModulePages(L"foo.dll", 5));
+  EXPECT_EQ(2U, timeline.CountModulePages(L"foo.dll", 10));
+  EXPECT_EQ(1U, timeline.CountModulePages(L"bar.dll", 10));
+
+  // Page 16 is only counted once, and page 20 is past the end of the module.
+  EXPECT_EQ(3U, timeline.CountModulePages(L"FOO.DLL", 20));
+  EXPECT_EQ(0U, timeline.CountModulePages(L"baz.dll", 20));
+}
+
+}  // namespace wsdump
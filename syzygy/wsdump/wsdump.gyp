@@ -22,10 +22,15 @@
       'type': 'static_library',
       'sources': [
         'process_working_set.h',
-        'process_working_set.cc'
+        'process_working_set.cc',
+        'working_set_sampler.cc',
+        'working_set_sampler.h',
+        'working_set_timeline.cc',
+        'working_set_timeline.h',
       ],
       'dependencies': [
         '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/core/core.gyp:core_lib',
       ],
     },
     {
@@ -33,6 +38,8 @@
       'type': 'executable',
       'sources': [
         'process_working_set_unittest.cc',
+        'working_set_sampler_unittest.cc',
+        'working_set_timeline_unittest.cc',
         'wsdump_unittests_main.cc'
       ],
       'dependencies': [
@@ -20,12 +20,19 @@
 #include "base/file_util.h"
 #include "base/logging.h"
 #include "base/process_util.h"
+#include "base/string_number_conversions.h"
 #include "base/utf_string_conversions.h"
 #include "pcrecpp.h"  // NOLINT
 #include "syzygy/core/json_file_writer.h"
+#include "syzygy/core/serialization.h"
 #include "syzygy/wsdump/process_working_set.h"
+#include "syzygy/wsdump/working_set_sampler.h"
+#include "syzygy/wsdump/working_set_timeline.h"
 
 using wsdump::ProcessWorkingSet;
+using wsdump::WorkingSetSampler;
+using wsdump::WorkingSetTimeline;
+using wsdump::WorkingSetTimelineWriter;
 
 namespace {
 
@@ -68,6 +75,8 @@ bool RegexpProcessFilter::Includes(const base::ProcessEntry& entry) const {
 
 const char kUsage[] =
 "Usage: wsdump [--process-name=<process_re>]\n"
+"       wsdump --timeline-file=<path> [--process-name=<process_re>]\n"
+"              [--sample-interval-ms=<ms>] [--sample-count=<count>]\n"
 "\n"
 "    Captures and outputs working set statistics for all processes,\n"
 "    or only for processess whose executable name matches <process_re>.\n"
@@ -106,7 +115,17 @@ const char kUsage[] =
 "        \"executable_pages\": 8959\n"
 "      },\n"
 "      {\n"
-" ... \n";
+" ... \n"
+"\n"
+"    In continuous sampling mode, selected by --timeline-file, wsdump waits\n"
+"    for the first process matching <process_re> to start, then captures\n"
+"    its working set every <ms> milliseconds (default 50) until it exits or\n"
+"    until <count> samples have been taken. Each sample only records the\n"
+"    modules loaded and the pages faulted in since the previous one, and\n"
+"    the samples are streamed to <path> as a binary working set timeline.\n"
+"    The timeline can be fed to order_benchmark.\n";
+
+const int kDefaultSampleIntervalMs = 50;
 
 int Usage() {
   std::cout << kUsage;
@@ -173,6 +192,60 @@ void OutputProcessInfo(const ProcessInfo& info,
   json->CloseDict();
 }
 
+// Waits for a process matching @p filter to start, and streams a timeline of
+// its working set to @p timeline_path.
+// @returns the process exit code for wsdump.
+int SampleWorkingSetTimeline(const base::ProcessFilter& filter,
+                             const base::FilePath& timeline_path,
+                             int interval_ms,
+                             int sample_count) {
+  const base::ProcessEntry* entry = NULL;
+  while (true) {
+    base::ProcessIterator process_iterator(&filter);
+    entry = process_iterator.NextProcessEntry();
+    if (entry != NULL)
+      break;
+    ::Sleep(interval_ms);
+  }
+
+  WorkingSetSampler sampler;
+  if (!sampler.Initialize(entry->pid())) {
+    LOG(ERROR) << "Unable to sample the working set of pid: " << entry->pid();
+    return 1;
+  }
+
+  file_util::ScopedFILE timeline_file(
+      file_util::OpenFile(timeline_path, "wb"));
+  if (timeline_file.get() == NULL) {
+    LOG(ERROR) << "Unable to open " << timeline_path.value() << ".";
+    return 1;
+  }
+  core::FileOutStream out_stream(timeline_file.get());
+  WorkingSetTimelineWriter writer(&out_stream);
+  if (!writer.WriteHeader())
+    return 1;
+
+  for (int i = 0; sample_count == 0 || i < sample_count; ++i) {
+    WorkingSetTimeline::Sample sample;
+    if (!sampler.Sample(&sample)) {
+      // The process may have exited since the last sample.
+      if (::WaitForSingleObject(sampler.process(), 0) == WAIT_OBJECT_0)
+        break;
+      LOG(ERROR) << "Unable to sample the working set.";
+      return 1;
+    }
+    if (!writer.WriteSample(sample))
+      return 1;
+
+    if (::WaitForSingleObject(sampler.process(), interval_ms) ==
+            WAIT_OBJECT_0) {
+      break;
+    }
+  }
+
+  return 0;
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -200,6 +273,24 @@ int main(int argc, char** argv) {
     return 1;
   }
 
+  base::FilePath timeline_path = cmd_line->GetSwitchValuePath("timeline-file");
+  if (!timeline_path.empty()) {
+    int interval_ms = kDefaultSampleIntervalMs;
+    int sample_count = 0;
+    std::string interval_str =
+        cmd_line->GetSwitchValueASCII("sample-interval-ms");
+    std::string count_str = cmd_line->GetSwitchValueASCII("sample-count");
+    if ((!interval_str.empty() &&
+         (!base::StringToInt(interval_str, &interval_ms) ||
+          interval_ms <= 0)) ||
+        (!count_str.empty() &&
+         (!base::StringToInt(count_str, &sample_count) || sample_count <= 0))) {
+      return Usage();
+    }
+    return SampleWorkingSetTimeline(filter, timeline_path, interval_ms,
+                                    sample_count);
+  }
+
   typedef std::list<ProcessInfo> WorkingSets;
   WorkingSets working_sets;
 
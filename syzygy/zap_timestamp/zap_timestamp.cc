@@ -27,7 +27,10 @@
 // The matching PDB file is completely rewritten to guarantee that it is
 // canonical (as long as the underlying PdbWriter doesn't change). We load all
 // of the streams into memory, reach in and make local modifications, and
-// rewrite the entire file to disk.
+// rewrite the entire file to disk. Alternatively, the streams that change are
+// compared to the original ones and only the bytes that differ are patched,
+// through a mapping of the file. This is much cheaper for large PDBs, but
+// preserves the layout chosen by the linker.
 
 #include "syzygy/zap_timestamp/zap_timestamp.h"
 
@@ -39,9 +42,12 @@
 #include "base/md5.h"
 #include "base/stringprintf.h"
 #include "base/files/scoped_temp_dir.h"
+#include "base/win/scoped_handle.h"
 #include "syzygy/block_graph/typed_block.h"
+#include "syzygy/common/com_utils.h"
 #include "syzygy/pdb/pdb_byte_stream.h"
 #include "syzygy/pdb/pdb_constants.h"
+#include "syzygy/pdb/pdb_file_stream.h"
 #include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/pdb_util.h"
 #include "syzygy/pdb/pdb_writer.h"
@@ -61,6 +67,7 @@ using core::FileOffsetAddress;
 using core::RelativeAddress;
 using pdb::PdbByteStream;
 using pdb::PdbFile;
+using pdb::PdbFileStream;
 using pdb::PdbReader;
 using pdb::PdbStream;
 using pdb::PdbWriter;
@@ -77,11 +84,17 @@ typedef ZapTimestamp::PatchAddressSpace PatchAddressSpace;
 typedef ZapTimestamp::PatchData PatchData;
 
 const char kUsageFormatStr[] =
-    "Usage: %ls <PE files>\n"
+    "Usage: %ls [options] <PE files>\n"
     "\n"
     "  A tool that normalizes the GUID and timestamps associated with a given\n"
     "  PE/PDB file pair. The PDB files matching each given PE file will be\n"
-    "  tracked down automatically.\n";
+    "  tracked down automatically.\n"
+    "\n"
+    "Options:\n"
+    "  --patch-pdb-in-place  Only write the bytes of the PDB files that\n"
+    "                        change rather than rewriting them. This is much\n"
+    "                        faster for large PDBs, but their layout is left\n"
+    "                        as the linker produced it.\n";
 
 void PrintUsage(FILE* out,
                 const base::FilePath& program,
@@ -346,26 +359,86 @@ bool UpdateFileInPlace(const base::FilePath& path,
   return true;
 }
 
-// Ensures that the stream with the given ID is writable, returning a scoped
-// pointer to it.
-scoped_refptr<PdbStream> GetWritablePdbStream(size_t index,
-                                              PdbFile* pdb_file) {
+// Patches the file at @p path in place with @p updates, through a mapping of
+// the file. This is cheaper than seeking and writing when there are many small
+// updates.
+bool PatchMappedFile(const base::FilePath& path,
+                     const PatchAddressSpace& updates) {
+  LOG(INFO) << "Patching mapped file: " << path.value();
+
+  if (updates.empty())
+    return true;
+
+  base::win::ScopedHandle file(::CreateFile(
+      path.value().c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL,
+      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+  if (!file.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to open file for updating: " << path.value() << ": "
+               << common::LogWe(error) << ".";
+    return false;
+  }
+
+  base::win::ScopedHandle mapping(::CreateFileMapping(
+      file.Get(), NULL, PAGE_READWRITE, 0, 0, NULL));
+  if (!mapping.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to map file: " << path.value() << ": "
+               << common::LogWe(error) << ".";
+    return false;
+  }
+
+  uint8* view = reinterpret_cast<uint8*>(
+      ::MapViewOfFile(mapping.Get(), FILE_MAP_WRITE, 0, 0, 0));
+  if (view == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to map view of file: " << path.value() << ": "
+               << common::LogWe(error) << ".";
+    return false;
+  }
+
+  size_t bytes_patched = 0;
+  PatchAddressSpace::const_iterator it = updates.begin();
+  for (; it != updates.end(); ++it) {
+    DCHECK(it->second.data != NULL);
+    VLOG(1) << "  Patching " << it->second.name << ", " << it->first.size()
+            << " bytes at " << it->first.start();
+    ::memcpy(view + it->first.start().value(), it->second.data,
+             it->first.size());
+    bytes_patched += it->first.size();
+  }
+
+  bool success = true;
+  if (!::FlushViewOfFile(view, 0)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to flush mapped file: " << path.value() << ": "
+               << common::LogWe(error) << ".";
+    success = false;
+  }
+  ::UnmapViewOfFile(view);
+
+  LOG(INFO) << "Patched " << bytes_patched << " bytes in " << updates.size()
+            << " ranges of file: " << path.value();
+
+  return success;
+}
+
+// Returns an in-memory, and therefore writable, copy of the stream @p index of
+// @p pdb_file. Returns NULL if there is no such stream.
+scoped_refptr<PdbByteStream> CopyPdbStream(size_t index, PdbFile* pdb_file) {
   DCHECK(pdb_file != NULL);
-  DCHECK_GT(pdb_file->StreamCount(), index);
 
+  if (index >= pdb_file->StreamCount())
+    return NULL;
   scoped_refptr<PdbStream> reader = pdb_file->GetStream(index);
+  if (reader.get() == NULL)
+    return NULL;
 
-  // Try and get the writer. If it's not available, then replace the stream
-  // with a byte stream, which is in-place writable.
-  scoped_refptr<WritablePdbStream> writer = reader->GetWritablePdbStream();
-  if (writer.get() == NULL) {
-    scoped_refptr<PdbByteStream> byte_stream(new PdbByteStream());
-    byte_stream->Init(reader);
-    pdb_file->ReplaceStream(index, byte_stream);
-    reader = byte_stream;
-  }
+  scoped_refptr<PdbByteStream> byte_stream(new PdbByteStream());
+  if (!byte_stream->Init(reader))
+    return NULL;
 
-  return reader;
+  return byte_stream;
 }
 
 void OutputSummaryStats(base::FilePath& path) {
@@ -506,7 +579,8 @@ bool NormalizeSymbolRecordStream(PdbByteStream* stream) {
 
 ZapTimestamp::ZapTimestamp()
     : image_layout_(&block_graph_),
-      dos_header_block_(NULL) {
+      dos_header_block_(NULL),
+      patch_pdb_in_place_(false) {
   // The timestamp can't just be set to zero as that represents a special
   // value in the PE file. We set it to some arbitrary fixed date in the past.
   // This is Y2K: Jan 1, 2000, 0:00:00 GMT.
@@ -543,6 +617,9 @@ bool ZapTimestamp::Init(const base::FilePath& pe_path,
   if (!LoadAndUpdatePdbFile())
     return false;
 
+  if (patch_pdb_in_place_ && !MarkPdbFileRanges())
+    return false;
+
   return true;
 }
 
@@ -813,20 +890,33 @@ bool ZapTimestamp::LoadAndUpdatePdbFile() {
     return false;
   }
 
-  // We turf the old directory stream as a fresh PDB does not have one. It's
-  // also meaningless after we rewrite a PDB as the old blocks it refers to
-  // will no longer exist.
-  pdb_file_->ReplaceStream(pdb::kPdbOldDirectoryStream, NULL);
+  if (!patch_pdb_in_place_) {
+    // We turf the old directory stream as a fresh PDB does not have one. It's
+    // also meaningless after we rewrite a PDB as the old blocks it refers to
+    // will no longer exist.
+    pdb_file_->ReplaceStream(pdb::kPdbOldDirectoryStream, NULL);
+  } else {
+    // The old directory stream can't be removed in place, so blank it out.
+    scoped_refptr<PdbStream> old_directory =
+        pdb_file_->GetStream(pdb::kPdbOldDirectoryStream);
+    if (old_directory.get() != NULL && old_directory->length() != 0) {
+      std::vector<uint8> zeros(old_directory->length(), 0);
+      scoped_refptr<PdbByteStream> blank_stream(new PdbByteStream());
+      CHECK(blank_stream->Init(&zeros[0], zeros.size()));
+      ReplacePdbStream(pdb::kPdbOldDirectoryStream, blank_stream);
+    }
+  }
 
-  scoped_refptr<PdbStream> header_reader =
-      GetWritablePdbStream(pdb::kPdbHeaderInfoStream, pdb_file_.get());
-  if (header_reader.get() == NULL) {
+  scoped_refptr<PdbByteStream> header_stream =
+      CopyPdbStream(pdb::kPdbHeaderInfoStream, pdb_file_.get());
+  if (header_stream.get() == NULL) {
     LOG(ERROR) << "No header info stream in PDB file: " << pdb_path_.value();
     return false;
   }
+  ReplacePdbStream(pdb::kPdbHeaderInfoStream, header_stream);
 
   scoped_refptr<WritablePdbStream> header_writer =
-      header_reader->GetWritablePdbStream();
+      header_stream->GetWritablePdbStream();
   DCHECK(header_writer.get() != NULL);
 
   // Update the timestamp, the age and the signature.
@@ -837,9 +927,10 @@ bool ZapTimestamp::LoadAndUpdatePdbFile() {
   header_writer->Write(pdb_guid_data_);
 
   // Normalize the DBI stream in place.
-  scoped_refptr<PdbByteStream> dbi_stream(new PdbByteStream());
-  CHECK(dbi_stream->Init(pdb_file_->GetStream(pdb::kDbiStream)));
-  pdb_file_->ReplaceStream(pdb::kDbiStream, dbi_stream);
+  scoped_refptr<PdbByteStream> dbi_stream =
+      CopyPdbStream(pdb::kDbiStream, pdb_file_.get());
+  CHECK(dbi_stream.get() != NULL);
+  ReplacePdbStream(pdb::kDbiStream, dbi_stream);
   if (!NormalizeDbiStream(pdb_age_data_, dbi_stream)) {
     LOG(ERROR) << "Failed to normalize DBI stream.";
     return false;
@@ -849,10 +940,10 @@ bool ZapTimestamp::LoadAndUpdatePdbFile() {
   pdb::DbiHeader* dbi_header = reinterpret_cast<pdb::DbiHeader*>(dbi_data);
 
   // Normalize the symbol record stream in place.
-  scoped_refptr<PdbByteStream> symrec_stream(new PdbByteStream());
-  CHECK(symrec_stream->Init(pdb_file_->GetStream(
-      dbi_header->symbol_record_stream)));
-  pdb_file_->ReplaceStream(dbi_header->symbol_record_stream, symrec_stream);
+  scoped_refptr<PdbByteStream> symrec_stream =
+      CopyPdbStream(dbi_header->symbol_record_stream, pdb_file_.get());
+  CHECK(symrec_stream.get() != NULL);
+  ReplacePdbStream(dbi_header->symbol_record_stream, symrec_stream);
   if (!NormalizeSymbolRecordStream(symrec_stream)) {
     LOG(ERROR) << "Failed to normalize symbol record stream.";
     return false;
@@ -860,10 +951,12 @@ bool ZapTimestamp::LoadAndUpdatePdbFile() {
 
   // Normalize the public symbol info stream. There's a DWORD of padding at
   // offset 24 that we want to zero.
-  scoped_refptr<PdbStream> pubsym_reader = GetWritablePdbStream(
-      dbi_header->public_symbol_info_stream, pdb_file_.get());
+  scoped_refptr<PdbByteStream> pubsym_stream =
+      CopyPdbStream(dbi_header->public_symbol_info_stream, pdb_file_.get());
+  CHECK(pubsym_stream.get() != NULL);
+  ReplacePdbStream(dbi_header->public_symbol_info_stream, pubsym_stream);
   scoped_refptr<WritablePdbStream> pubsym_writer =
-      pubsym_reader->GetWritablePdbStream();
+      pubsym_stream->GetWritablePdbStream();
   DCHECK(pubsym_writer.get() != NULL);
   pubsym_writer->set_pos(24);
   pubsym_writer->Write(static_cast<uint32>(0));
@@ -871,6 +964,87 @@ bool ZapTimestamp::LoadAndUpdatePdbFile() {
   return true;
 }
 
+void ZapTimestamp::ReplacePdbStream(size_t index, PdbByteStream* stream) {
+  DCHECK(pdb_file_.get() != NULL);
+  DCHECK(stream != NULL);
+
+  // Only the first replacement of a stream sees the original.
+  PdbStreamUpdate& update = pdb_stream_updates_[index];
+  if (update.original.get() == NULL)
+    update.original = pdb_file_->GetStream(index);
+  update.updated = stream;
+
+  pdb_file_->ReplaceStream(index, stream);
+}
+
+bool ZapTimestamp::MarkPdbFileRanges() {
+  DCHECK(patch_pdb_in_place_);
+  LOG(INFO) << "Finding PDB bytes that need updating.";
+
+  PdbStreamUpdateMap::const_iterator it = pdb_stream_updates_.begin();
+  for (; it != pdb_stream_updates_.end(); ++it) {
+    size_t index = it->first;
+    PdbStream* original = it->second.original.get();
+    PdbByteStream* updated = it->second.updated.get();
+    DCHECK(original != NULL);
+    DCHECK(updated != NULL);
+
+    size_t length = original->length();
+    if (updated->length() != length) {
+      LOG(ERROR) << "PDB stream " << index << " can't be patched in place as "
+                 << "its length changed.";
+      return false;
+    }
+    if (length == 0)
+      continue;
+
+    std::vector<uint8> original_data;
+    if (!original->Seek(0) || !original->Read(&original_data, length)) {
+      LOG(ERROR) << "Failed to read PDB stream " << index << ".";
+      return false;
+    }
+
+    // The original streams were all read by PdbReader, so they live in the
+    // PDB file.
+    const PdbFileStream* file_stream =
+        static_cast<const PdbFileStream*>(original);
+    size_t page_size = file_stream->page_size();
+    const std::vector<uint32>& pages = file_stream->pages();
+
+    // Mark each run of changed bytes, split at the page boundaries as the
+    // pages of a stream are scattered through the file.
+    const uint8* updated_data = updated->data();
+    std::string name = base::StringPrintf("PDB Stream %d", index);
+    size_t offset = 0;
+    while (offset < length) {
+      if (original_data[offset] == updated_data[offset]) {
+        ++offset;
+        continue;
+      }
+
+      size_t page_end = std::min(length, (offset / page_size + 1) * page_size);
+      size_t end = offset + 1;
+      while (end < page_end && original_data[end] != updated_data[end])
+        ++end;
+
+      DCHECK_GT(pages.size(), offset / page_size);
+      FileOffsetAddress file_addr(
+          pages[offset / page_size] * page_size + offset % page_size);
+      if (!pdb_file_addr_space_.Insert(
+              PatchAddressSpace::Range(file_addr, end - offset),
+              PatchData(updated_data + offset, name))) {
+        LOG(ERROR) << "Failed to insert PDB file range at " << file_addr
+                   << " of length " << end - offset << ".";
+        return false;
+      }
+
+      offset = end;
+    }
+  }
+
+  return true;
+}
+
 bool ZapTimestamp::WritePeFile() {
   if (!UpdateFileInPlace(pe_path_, pe_file_addr_space_))
     return false;
@@ -885,6 +1059,17 @@ bool ZapTimestamp::WritePeFile() {
 }
 
 bool ZapTimestamp::WritePdbFile() {
+  if (patch_pdb_in_place_) {
+    // Release the PDB file and the original streams, closing the open file
+    // handles to it. The updated streams house the data to be written.
+    pdb_file_.reset(NULL);
+    PdbStreamUpdateMap::iterator it = pdb_stream_updates_.begin();
+    for (; it != pdb_stream_updates_.end(); ++it)
+      it->second.original = NULL;
+
+    return PatchMappedFile(pdb_path_, pdb_file_addr_space_);
+  }
+
   // We actually completely rewrite the PDB file to a temporary location, and
   // then move it over top of the existing one. This is because pdb_file_
   // actually has an open file handle to the original PDB.
@@ -927,6 +1112,8 @@ bool ZapTimestamp::WritePdbFile() {
 bool ZapTimestampApp::ParseCommandLine(const CommandLine* command_line) {
   DCHECK(command_line != NULL);
 
+  patch_pdb_in_place_ = command_line->HasSwitch("patch-pdb-in-place");
+
   CommandLine::StringVector args = command_line->GetArgs();
   if (args.empty()) {
     PrintUsage(out(), command_line->GetProgram(),
@@ -945,6 +1132,7 @@ bool ZapTimestampApp::ParseCommandLine(const CommandLine* command_line) {
 int ZapTimestampApp::Run() {
   for (size_t i = 0; i < input_modules_.size(); ++i) {
     ZapTimestamp zap;
+    zap.set_patch_pdb_in_place(patch_pdb_in_place_);
     if (!zap.Init(input_modules_[i]) || !zap.Zap(true, true))
       return 1;
   }
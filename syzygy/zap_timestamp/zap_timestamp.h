@@ -21,6 +21,7 @@
 #ifndef SYZYGY_ZAP_TIMESTAMP_ZAP_TIMESTAMP_H_
 #define SYZYGY_ZAP_TIMESTAMP_ZAP_TIMESTAMP_H_
 
+#include <map>
 #include <vector>
 
 #include "base/string_piece.h"
@@ -28,6 +29,7 @@
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/common/application.h"
 #include "syzygy/core/address_space.h"
+#include "syzygy/pdb/pdb_byte_stream.h"
 #include "syzygy/pdb/pdb_file.h"
 #include "syzygy/pe/image_layout.h"
 #include "syzygy/pe/pe_file.h"
@@ -65,8 +67,19 @@ class ZapTimestamp {
   // @{
   const base::FilePath& pe_path() const { return pe_path_; }
   const base::FilePath& pdb_path() const { return pdb_path_; }
+  bool patch_pdb_in_place() const { return patch_pdb_in_place_; }
   // @}
 
+  // Indicates whether the PDB file is patched in place rather than being
+  // rewritten. Only the bytes that change are then written, which is much
+  // faster for large PDBs. However, the layout of the PDB is preserved, so
+  // the result is only as deterministic as the layout produced by the linker.
+  // @param patch_pdb_in_place true to patch the PDB in place.
+  // @note This must be called before Init.
+  void set_patch_pdb_in_place(bool patch_pdb_in_place) {
+    patch_pdb_in_place_ = patch_pdb_in_place;
+  }
+
   // Forward declarations. These are public so they can be used by anonymous
   // helper functions in zap_timestamp.cc.
   struct PatchData;
@@ -92,6 +105,15 @@ class ZapTimestamp {
   // Loads the PDB file and updates its in-memory representation.
   bool LoadAndUpdatePdbFile();
 
+  // Replaces the stream @p index of pdb_file_ with @p stream, remembering the
+  // original stream so that the changes can be patched in place.
+  void ReplacePdbStream(size_t index, pdb::PdbByteStream* stream);
+
+  // Paints the regions of the PDB file that need to be modified, by comparing
+  // the updated streams to the original ones. Only used when patching the PDB
+  // in place.
+  bool MarkPdbFileRanges();
+
   // @{
   // These do the actual writing of the individual files.
   bool WritePeFile();
@@ -114,6 +136,21 @@ class ZapTimestamp {
   // Populated by LoadPdbFile and modified by UpdatePdbFile.
   scoped_ptr<pdb::PdbFile> pdb_file_;
 
+  // The streams of the PDB file that have been replaced by updated copies,
+  // and the original streams they replace. Populated by ReplacePdbStream.
+  struct PdbStreamUpdate {
+    scoped_refptr<pdb::PdbStream> original;
+    scoped_refptr<pdb::PdbByteStream> updated;
+  };
+  typedef std::map<size_t, PdbStreamUpdate> PdbStreamUpdateMap;
+  PdbStreamUpdateMap pdb_stream_updates_;
+
+  // Populated by MarkPdbFileRanges when patching the PDB in place.
+  PatchAddressSpace pdb_file_addr_space_;
+
+  // Indicates whether the PDB file is patched in place.
+  bool patch_pdb_in_place_;
+
   // These house the new values to be written when the image is zapped.
   DWORD timestamp_data_;
   DWORD pdb_age_data_;
@@ -136,7 +173,9 @@ struct ZapTimestamp::PatchData {
 // The application class that actually runs ZapTimestamp.
 class ZapTimestampApp : public common::AppImplBase {
  public:
-  ZapTimestampApp() : AppImplBase("Zap Timestamp") { }
+  ZapTimestampApp()
+      : AppImplBase("Zap Timestamp"), patch_pdb_in_place_(false) {
+  }
 
   // @name Implementation of the AppImplbase interface.
   // @{
@@ -148,6 +187,9 @@ class ZapTimestampApp : public common::AppImplBase {
   // The input modules to be zapped. Each one must be a PE file.
   std::vector<base::FilePath> input_modules_;
 
+  // Indicates whether the PDB files are patched in place.
+  bool patch_pdb_in_place_;
+
   DISALLOW_COPY_AND_ASSIGN(ZapTimestampApp);
 };
 
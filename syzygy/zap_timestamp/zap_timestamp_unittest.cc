@@ -18,6 +18,8 @@
 #include "base/files/scoped_temp_dir.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
+#include "syzygy/pdb/pdb_util.h"
+#include "syzygy/pe/find.h"
 
 namespace zap_timestamp {
 
@@ -185,4 +187,62 @@ TEST_F(ZapTimestampTest, Succeeds) {
   EXPECT_TRUE(file_util::ContentsEqual(temp_pdb_path_, pdb_path_1));
 }
 
+TEST_F(ZapTimestampTest, PatchPdbInPlaceMatchesRewrite) {
+  // Zap a copy of the PE and PDB files, rewriting the PDB.
+  ASSERT_NO_FATAL_FAILURE(CopyTestData(0));
+  ZapTimestamp zap0;
+  EXPECT_TRUE(zap0.Init(temp_pe_path_));
+  EXPECT_TRUE(zap0.Zap(true, true));
+
+  base::FilePath pe_path_0 = temp_dir_.path().Append(L"test_dll_0.dll");
+  base::FilePath pdb_path_0 = temp_dir_.path().Append(L"test_dll_0.pdb");
+  ASSERT_TRUE(file_util::Move(temp_pe_path_, pe_path_0));
+  ASSERT_TRUE(file_util::Move(temp_pdb_path_, pdb_path_0));
+
+  // Zap another copy, patching the PDB in place.
+  ASSERT_NO_FATAL_FAILURE(CopyTestData(0));
+  int64 pdb_size = 0;
+  ASSERT_TRUE(file_util::GetFileSize(temp_pdb_path_, &pdb_size));
+  ZapTimestamp zap1;
+  zap1.set_patch_pdb_in_place(true);
+  EXPECT_TRUE(zap1.patch_pdb_in_place());
+  EXPECT_TRUE(zap1.Init(temp_pe_path_));
+  EXPECT_TRUE(zap1.Zap(true, true));
+
+  // The PE files are the same, the PDB hasn't been rewritten and the two
+  // PDBs have the same header.
+  EXPECT_TRUE(file_util::ContentsEqual(temp_pe_path_, pe_path_0));
+  int64 patched_pdb_size = 0;
+  ASSERT_TRUE(file_util::GetFileSize(temp_pdb_path_, &patched_pdb_size));
+  EXPECT_EQ(pdb_size, patched_pdb_size);
+  EXPECT_TRUE(pe::PeAndPdbAreMatched(temp_pe_path_, temp_pdb_path_));
+
+  pdb::PdbInfoHeader70 header0 = {};
+  pdb::PdbInfoHeader70 header1 = {};
+  ASSERT_TRUE(pdb::ReadPdbHeader(pdb_path_0, &header0));
+  ASSERT_TRUE(pdb::ReadPdbHeader(temp_pdb_path_, &header1));
+  EXPECT_EQ(0, ::memcmp(&header0, &header1, sizeof(header0)));
+}
+
+TEST_F(ZapTimestampTest, PatchPdbInPlaceIsIdempotent) {
+  ASSERT_NO_FATAL_FAILURE(CopyTestData(0));
+  ZapTimestamp zap0;
+  zap0.set_patch_pdb_in_place(true);
+  EXPECT_TRUE(zap0.Init(temp_pe_path_));
+  EXPECT_TRUE(zap0.Zap(true, true));
+
+  base::FilePath pe_path_0 = temp_dir_.path().Append(L"test_dll_0.dll");
+  base::FilePath pdb_path_0 = temp_dir_.path().Append(L"test_dll_0.pdb");
+  ASSERT_TRUE(file_util::CopyFile(temp_pe_path_, pe_path_0));
+  ASSERT_TRUE(file_util::CopyFile(temp_pdb_path_, pdb_path_0));
+
+  ZapTimestamp zap1;
+  zap1.set_patch_pdb_in_place(true);
+  EXPECT_TRUE(zap1.Init(temp_pe_path_));
+  EXPECT_TRUE(zap1.Zap(true, true));
+
+  EXPECT_TRUE(file_util::ContentsEqual(temp_pe_path_, pe_path_0));
+  EXPECT_TRUE(file_util::ContentsEqual(temp_pdb_path_, pdb_path_0));
+}
+
 }  // namespace zap_timestamp